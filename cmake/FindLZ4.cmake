@@ -0,0 +1,53 @@
+# Copyright (c) 2021
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230
+#
+# Author: Kazys Stepanas
+
+# This module searches for the LZ4 compression library and defines
+# LZ4_FOUND - true if LZ4 headers and libraries are found
+# LZ4_INCLUDE_DIR - LZ4 include directory
+# LZ4_LIBRARIES - LZ4 link libraries
+#
+# The imported target LZ4::LZ4 is also defined when LZ4 is found.
+#
+# $LZ4_DIR is an environment variable that may be set to indicate the LZ4 installation prefix.
+
+find_path(LZ4_INCLUDE_DIR lz4.h HINTS ENV LZ4_DIR PATH_SUFFIXES include)
+
+find_library(LZ4_LIBRARY_DEBUG NAMES lz4d HINTS ENV LZ4_DIR PATH_SUFFIXES lib)
+find_library(LZ4_LIBRARY_RELEASE NAMES lz4 liblz4 HINTS ENV LZ4_DIR PATH_SUFFIXES lib)
+
+set(LZ4_LIBRARIES)
+if(LZ4_LIBRARY_DEBUG)
+  list(APPEND LZ4_LIBRARIES debug ${LZ4_LIBRARY_DEBUG})
+  if(LZ4_LIBRARY_RELEASE)
+    list(APPEND LZ4_LIBRARIES optimized ${LZ4_LIBRARY_RELEASE})
+  endif(LZ4_LIBRARY_RELEASE)
+else(LZ4_LIBRARY_DEBUG)
+  list(APPEND LZ4_LIBRARIES ${LZ4_LIBRARY_RELEASE})
+endif(LZ4_LIBRARY_DEBUG)
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LZ4 REQUIRED_VARS LZ4_LIBRARIES LZ4_INCLUDE_DIR)
+
+if(LZ4_FOUND)
+  mark_as_advanced(LZ4_INCLUDE_DIR LZ4_LIBRARIES LZ4_LIBRARY_DEBUG LZ4_LIBRARY_RELEASE)
+
+  if(NOT TARGET LZ4::LZ4)
+    add_library(LZ4::LZ4 UNKNOWN IMPORTED)
+    set_target_properties(LZ4::LZ4 PROPERTIES INTERFACE_INCLUDE_DIRECTORIES "${LZ4_INCLUDE_DIR}")
+    if(LZ4_LIBRARY_RELEASE)
+      set_property(TARGET LZ4::LZ4 APPEND PROPERTY IMPORTED_CONFIGURATIONS RELEASE)
+      set_target_properties(LZ4::LZ4 PROPERTIES IMPORTED_LOCATION_RELEASE "${LZ4_LIBRARY_RELEASE}")
+      set_target_properties(LZ4::LZ4 PROPERTIES IMPORTED_LOCATION "${LZ4_LIBRARY_RELEASE}")
+    endif(LZ4_LIBRARY_RELEASE)
+    if(LZ4_LIBRARY_DEBUG)
+      set_property(TARGET LZ4::LZ4 APPEND PROPERTY IMPORTED_CONFIGURATIONS DEBUG)
+      set_target_properties(LZ4::LZ4 PROPERTIES IMPORTED_LOCATION_DEBUG "${LZ4_LIBRARY_DEBUG}")
+      if(NOT LZ4_LIBRARY_RELEASE)
+        set_target_properties(LZ4::LZ4 PROPERTIES IMPORTED_LOCATION "${LZ4_LIBRARY_DEBUG}")
+      endif(NOT LZ4_LIBRARY_RELEASE)
+    endif(LZ4_LIBRARY_DEBUG)
+  endif(NOT TARGET LZ4::LZ4)
+endif(LZ4_FOUND)
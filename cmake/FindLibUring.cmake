@@ -0,0 +1,53 @@
+# Copyright (c) 2021
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230
+#
+# Author: Kazys Stepanas
+
+# This module searches for the liburing io_uring library and defines
+# LibUring_FOUND - true if liburing headers and libraries are found
+# LibUring_INCLUDE_DIR - liburing include directory
+# LibUring_LIBRARIES - liburing link libraries
+#
+# The imported target LibUring::LibUring is also defined when liburing is found.
+#
+# $LIBURING_DIR is an environment variable that may be set to indicate the liburing installation prefix.
+
+find_path(LibUring_INCLUDE_DIR liburing.h HINTS ENV LIBURING_DIR PATH_SUFFIXES include)
+
+find_library(LibUring_LIBRARY_DEBUG NAMES uringd HINTS ENV LIBURING_DIR PATH_SUFFIXES lib)
+find_library(LibUring_LIBRARY_RELEASE NAMES uring liburing HINTS ENV LIBURING_DIR PATH_SUFFIXES lib)
+
+set(LibUring_LIBRARIES)
+if(LibUring_LIBRARY_DEBUG)
+  list(APPEND LibUring_LIBRARIES debug ${LibUring_LIBRARY_DEBUG})
+  if(LibUring_LIBRARY_RELEASE)
+    list(APPEND LibUring_LIBRARIES optimized ${LibUring_LIBRARY_RELEASE})
+  endif(LibUring_LIBRARY_RELEASE)
+else(LibUring_LIBRARY_DEBUG)
+  list(APPEND LibUring_LIBRARIES ${LibUring_LIBRARY_RELEASE})
+endif(LibUring_LIBRARY_DEBUG)
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LibUring REQUIRED_VARS LibUring_LIBRARIES LibUring_INCLUDE_DIR)
+
+if(LibUring_FOUND)
+  mark_as_advanced(LibUring_INCLUDE_DIR LibUring_LIBRARIES LibUring_LIBRARY_DEBUG LibUring_LIBRARY_RELEASE)
+
+  if(NOT TARGET LibUring::LibUring)
+    add_library(LibUring::LibUring UNKNOWN IMPORTED)
+    set_target_properties(LibUring::LibUring PROPERTIES INTERFACE_INCLUDE_DIRECTORIES "${LibUring_INCLUDE_DIR}")
+    if(LibUring_LIBRARY_RELEASE)
+      set_property(TARGET LibUring::LibUring APPEND PROPERTY IMPORTED_CONFIGURATIONS RELEASE)
+      set_target_properties(LibUring::LibUring PROPERTIES IMPORTED_LOCATION_RELEASE "${LibUring_LIBRARY_RELEASE}")
+      set_target_properties(LibUring::LibUring PROPERTIES IMPORTED_LOCATION "${LibUring_LIBRARY_RELEASE}")
+    endif(LibUring_LIBRARY_RELEASE)
+    if(LibUring_LIBRARY_DEBUG)
+      set_property(TARGET LibUring::LibUring APPEND PROPERTY IMPORTED_CONFIGURATIONS DEBUG)
+      set_target_properties(LibUring::LibUring PROPERTIES IMPORTED_LOCATION_DEBUG "${LibUring_LIBRARY_DEBUG}")
+      if(NOT LibUring_LIBRARY_RELEASE)
+        set_target_properties(LibUring::LibUring PROPERTIES IMPORTED_LOCATION "${LibUring_LIBRARY_DEBUG}")
+      endif(NOT LibUring_LIBRARY_RELEASE)
+    endif(LibUring_LIBRARY_DEBUG)
+  endif(NOT TARGET LibUring::LibUring)
+endif(LibUring_FOUND)
@@ -55,5 +55,7 @@ endif(DYNAMICEDT3D_LIBRARY_DEBUG)
 # all listed variables are TRUE
 include(FindPackageHandleStandardArgs)
 FIND_PACKAGE_HANDLE_STANDARD_ARGS(OCTOMAP REQUIRED_VARS OCTOMAP_LIBRARIES OCTOMAP_INCLUDE_DIRS)
+# Match the find_package(Octomap) case.
+set(Octomap_FOUND ${OCTOMAP_FOUND})
 
 mark_as_advanced(OCTOMAP_INCLUDE_DIRS OCTOMAP_LIBRARIES)
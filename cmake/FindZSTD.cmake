@@ -0,0 +1,53 @@
+# Copyright (c) 2021
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230
+#
+# Author: Kazys Stepanas
+
+# This module searches for the Zstandard (zstd) compression library and defines
+# ZSTD_FOUND - true if Zstd headers and libraries are found
+# ZSTD_INCLUDE_DIR - Zstd include directory
+# ZSTD_LIBRARIES - Zstd link libraries
+#
+# The imported target ZSTD::ZSTD is also defined when Zstd is found.
+#
+# $ZSTD_DIR is an environment variable that may be set to indicate the Zstd installation prefix.
+
+find_path(ZSTD_INCLUDE_DIR zstd.h HINTS ENV ZSTD_DIR PATH_SUFFIXES include)
+
+find_library(ZSTD_LIBRARY_DEBUG NAMES zstdd HINTS ENV ZSTD_DIR PATH_SUFFIXES lib)
+find_library(ZSTD_LIBRARY_RELEASE NAMES zstd libzstd zstd_static HINTS ENV ZSTD_DIR PATH_SUFFIXES lib)
+
+set(ZSTD_LIBRARIES)
+if(ZSTD_LIBRARY_DEBUG)
+  list(APPEND ZSTD_LIBRARIES debug ${ZSTD_LIBRARY_DEBUG})
+  if(ZSTD_LIBRARY_RELEASE)
+    list(APPEND ZSTD_LIBRARIES optimized ${ZSTD_LIBRARY_RELEASE})
+  endif(ZSTD_LIBRARY_RELEASE)
+else(ZSTD_LIBRARY_DEBUG)
+  list(APPEND ZSTD_LIBRARIES ${ZSTD_LIBRARY_RELEASE})
+endif(ZSTD_LIBRARY_DEBUG)
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(ZSTD REQUIRED_VARS ZSTD_LIBRARIES ZSTD_INCLUDE_DIR)
+
+if(ZSTD_FOUND)
+  mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARIES ZSTD_LIBRARY_DEBUG ZSTD_LIBRARY_RELEASE)
+
+  if(NOT TARGET ZSTD::ZSTD)
+    add_library(ZSTD::ZSTD UNKNOWN IMPORTED)
+    set_target_properties(ZSTD::ZSTD PROPERTIES INTERFACE_INCLUDE_DIRECTORIES "${ZSTD_INCLUDE_DIR}")
+    if(ZSTD_LIBRARY_RELEASE)
+      set_property(TARGET ZSTD::ZSTD APPEND PROPERTY IMPORTED_CONFIGURATIONS RELEASE)
+      set_target_properties(ZSTD::ZSTD PROPERTIES IMPORTED_LOCATION_RELEASE "${ZSTD_LIBRARY_RELEASE}")
+      set_target_properties(ZSTD::ZSTD PROPERTIES IMPORTED_LOCATION "${ZSTD_LIBRARY_RELEASE}")
+    endif(ZSTD_LIBRARY_RELEASE)
+    if(ZSTD_LIBRARY_DEBUG)
+      set_property(TARGET ZSTD::ZSTD APPEND PROPERTY IMPORTED_CONFIGURATIONS DEBUG)
+      set_target_properties(ZSTD::ZSTD PROPERTIES IMPORTED_LOCATION_DEBUG "${ZSTD_LIBRARY_DEBUG}")
+      if(NOT ZSTD_LIBRARY_RELEASE)
+        set_target_properties(ZSTD::ZSTD PROPERTIES IMPORTED_LOCATION "${ZSTD_LIBRARY_DEBUG}")
+      endif(NOT ZSTD_LIBRARY_RELEASE)
+    endif(ZSTD_LIBRARY_DEBUG)
+  endif(NOT TARGET ZSTD::ZSTD)
+endif(ZSTD_FOUND)
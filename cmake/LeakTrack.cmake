@@ -44,6 +44,8 @@
 #
 # Note that these directives are ignored when not building with GCC or Clang.
 #
+# Heap allocations may also be counted for an executable using leak_track_count_allocations(). See below.
+#
 # The following links provide some much needed information about using libasan, althought the documentation is scarce:
 # - Overview: https://github.com/google/sanitizers/wiki/AddressSanitizer
 # - Weak symbols for in code overrides: https://chromium.googlesource.com/chromium/src/build/+/master/sanitizers/sanitizer_options.cc
@@ -265,3 +267,126 @@ function(leak_track_target_enable TARGET)
     leak_track_target_enable_asan(${TARGET})
   endif(LEAK_TRACK_WITH_ASAN)
 endfunction(leak_track_target_enable)
+
+# Count heap allocations made via the global operator new for a target.
+#
+# leak_track_count_allocations(<target> [CONDITION condition])
+#
+# This replaces the global operator new and delete for the executable <target> with versions which count the number
+# of allocations and the bytes allocated, then forward to malloc() and free(). The counts may be read using the
+# following function, declared by the caller:
+#   extern "C" void leak_track_allocation_counts(unsigned long long *count, unsigned long long *bytes);
+# The target is also given the compile definition LEAK_TRACK_COUNT_ALLOCATIONS so the code may check if counting is
+# available. Counting may be combined with leak_track_target_enable().
+#
+# Only allocations made via operator new are counted, including those made in shared libraries, but not direct malloc()
+# calls. This is not supported with MSVC, where the replacement does not extend to DLLs.
+function(leak_track_count_allocations TARGET)
+  if(MSVC)
+    return()
+  endif(MSVC)
+
+  _leak_track_check_condition(CONDITION_OK _ARGN ${ARGN})
+  if(NOT CONDITION_OK)
+    return()
+  endif(NOT CONDITION_OK)
+
+  get_target_property(TARGET_TYPE ${TARGET} TYPE)
+  if(NOT TARGET_TYPE STREQUAL "EXECUTABLE")
+    message("Cannot count allocations for ${TARGET}: only executables can count allocations")
+    return()
+  endif(NOT TARGET_TYPE STREQUAL "EXECUTABLE")
+
+  set(COUNT_SOURCE [=[
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+std::atomic<unsigned long long> g_leak_track_allocation_count(0);
+std::atomic<unsigned long long> g_leak_track_allocation_bytes(0);
+
+void *leakTrackAllocate(std::size_t size) noexcept
+{
+  g_leak_track_allocation_count.fetch_add(1, std::memory_order_relaxed);
+  g_leak_track_allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+}  // namespace
+
+extern "C" void leak_track_allocation_counts(unsigned long long *count, unsigned long long *bytes)
+{
+  if (count)
+  {
+    *count = g_leak_track_allocation_count.load(std::memory_order_relaxed);
+  }
+  if (bytes)
+  {
+    *bytes = g_leak_track_allocation_bytes.load(std::memory_order_relaxed);
+  }
+}
+
+void *operator new(std::size_t size)
+{
+  void *ptr = leakTrackAllocate(size);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new[](std::size_t size)
+{
+  void *ptr = leakTrackAllocate(size);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  return leakTrackAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+  return leakTrackAllocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  std::free(ptr);
+}
+]=])
+  _leak_track_add_source(${TARGET} allocationCount.cpp "${COUNT_SOURCE}")
+  target_compile_definitions(${TARGET} PRIVATE LEAK_TRACK_COUNT_ALLOCATIONS)
+endfunction(leak_track_count_allocations)
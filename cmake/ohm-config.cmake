@@ -18,9 +18,12 @@ set(OHM_VERSION @ohm_VERSION@)
 
 set(OHM_FEATURE_CUDA @OHM_FEATURE_CUDA@)
 set(OHM_FEATURE_HEIGHTMAP_IMAGE @OHM_FEATURE_HEIGHTMAP_IMAGE@)
+set(OHM_FEATURE_LZ4 @OHM_FEATURE_LZ4@)
 set(OHM_FEATURE_OPENCL @OHM_FEATURE_OPENCL@)
 set(OHM_FEATURE_PDAL @OHM_FEATURE_PDAL@)
 set(OHM_FEATURE_THREADS @OHM_FEATURE_THREADS@)
+set(OHM_FEATURE_URING @OHM_FEATURE_URING@)
+set(OHM_FEATURE_ZSTD @OHM_FEATURE_ZSTD@)
 
 set(OHM_USE_DEPRECATED_CMAKE_CUDA @OHM_USE_DEPRECATED_CMAKE_CUDA@)
 
@@ -25,4 +25,18 @@ if(NOT OHM_BUILD_SHARED)
   endif(OHM_FEATURE_PDAL)
 
   find_package(ZLIB)
+
+  # FindLibUring.cmake, FindLZ4.cmake and FindZSTD.cmake are installed along side this file.
+  list(APPEND CMAKE_MODULE_PATH "${CMAKE_CURRENT_LIST_DIR}")
+  if(OHM_FEATURE_LZ4)
+    find_package(LZ4 REQUIRED)
+  endif(OHM_FEATURE_LZ4)
+
+  if(OHM_FEATURE_ZSTD)
+    find_package(ZSTD REQUIRED)
+  endif(OHM_FEATURE_ZSTD)
+
+  if(OHM_FEATURE_URING)
+    find_package(LibUring REQUIRED)
+  endif(OHM_FEATURE_URING)
 endif(NOT OHM_BUILD_SHARED)
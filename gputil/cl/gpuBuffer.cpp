@@ -49,7 +49,7 @@ size_t resizeBuffer(gputil::Buffer &buffer, gputil::BufferDetail &imp, size_t ne
   }
 
   // Needs resize.
-  imp.buffer = cl::Buffer();
+  gputil::releaseBuffer(imp);
 
   cl_mem_flags cl_flags = 0;
 
@@ -75,8 +75,38 @@ size_t resizeBuffer(gputil::Buffer &buffer, gputil::BufferDetail &imp, size_t ne
   }
 
   cl_int clerr = 0;
-  clu::ensureBufferSize<uint8_t>(imp.buffer, cl_flags, imp.device.detail()->context, new_size, &clerr);
-  GPUAPICHECK(clerr, CL_SUCCESS, 0);
+#if CL_HPP_TARGET_OPENCL_VERSION >= 200
+  if (imp.request_flags & gputil::kBfUnified)
+  {
+    // Fine grain buffer SVM allows host access while the device uses other parts of the allocation. We wrap the SVM
+    // allocation in a buffer object so kernel arguments are set as for any other buffer. Devices without SVM support
+    // report zero capabilities.
+    cl_device_svm_capabilities svm_caps = 0;
+    clGetDeviceInfo(imp.device.detail()->device(), CL_DEVICE_SVM_CAPABILITIES, sizeof(svm_caps), &svm_caps, nullptr);
+    if (svm_caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER)
+    {
+      // NOLINTNEXTLINE(hicpp-signed-bitwise)
+      imp.svm_ptr = clSVMAlloc(imp.device.detail()->context(), CL_MEM_READ_WRITE | CL_MEM_SVM_FINE_GRAIN_BUFFER,
+                               best_size, 0);
+      if (imp.svm_ptr)
+      {
+        // NOLINTNEXTLINE(hicpp-signed-bitwise)
+        imp.buffer = cl::Buffer(imp.device.detail()->context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, best_size,
+                                imp.svm_ptr, &clerr);
+        if (clerr != CL_SUCCESS)
+        {
+          gputil::releaseBuffer(imp);
+        }
+      }
+    }
+  }
+
+  if (!imp.svm_ptr)
+#endif  // CL_HPP_TARGET_OPENCL_VERSION >= 200
+  {
+    clu::ensureBufferSize<uint8_t>(imp.buffer, cl_flags, imp.device.detail()->context, new_size, &clerr);
+    GPUAPICHECK(clerr, CL_SUCCESS, 0);
+  }
 
   // Validate the CL_MEM_ALLOC_HOST_PTR flag worked.
   cl_mem_flags actual_flags = 0;
@@ -91,6 +121,11 @@ size_t resizeBuffer(gputil::Buffer &buffer, gputil::BufferDetail &imp, size_t ne
     // std::cout << "Failed host access " << std::endl;
   }
 
+  if (!imp.svm_ptr)
+  {
+    imp.flags &= ~gputil::kBfUnified;
+  }
+
   imp.requested_size = new_size;
   const size_t actual_size = buffer.actualSize();
 
@@ -112,6 +147,26 @@ size_t actualSize(const gputil::BufferDetail &imp)
 
 namespace gputil
 {
+BufferDetail::~BufferDetail()
+{
+  releaseBuffer(*this);
+}
+
+
+void releaseBuffer(BufferDetail &imp)
+{
+  // The buffer object must be released before the SVM memory it uses.
+  imp.buffer = cl::Buffer();
+#if CL_HPP_TARGET_OPENCL_VERSION >= 200
+  if (imp.svm_ptr)
+  {
+    clSVMFree(imp.device.detail()->context(), imp.svm_ptr);
+  }
+#endif  // CL_HPP_TARGET_OPENCL_VERSION >= 200
+  imp.svm_ptr = nullptr;
+}
+
+
 uint8_t *pin(BufferDetail &imp, PinMode mode)
 {
   cl_command_queue queue_cl = selectQueue(imp.device, nullptr);
@@ -230,8 +285,8 @@ void Buffer::create(const Device &device, size_t byte_size, unsigned flags)
 
 void Buffer::release()
 {
+  releaseBuffer(*imp_);
   imp_->device = Device();
-  imp_->buffer = cl::Buffer();
   imp_->request_flags = imp_->flags = 0;
 }
 
@@ -666,6 +721,12 @@ size_t Buffer::writeElements(const void *src, size_t element_size, size_t elemen
 }
 
 
+void *Buffer::hostPointer() const
+{
+  return (imp_) ? imp_->svm_ptr : nullptr;
+}
+
+
 void *Buffer::argPtr() const
 {
   if (imp_)
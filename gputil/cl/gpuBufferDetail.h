@@ -24,11 +24,17 @@ struct BufferDetail
 {
   Device device;
   cl::Buffer buffer;
+  /// Shared virtual memory backing @c buffer for @c kBfUnified buffers. Null otherwise.
+  void *svm_ptr = nullptr;
   size_t requested_size = 0;
   unsigned flags = 0;
   unsigned request_flags = 0;
+
+  ~BufferDetail();
 };
 
+/// Release the @c BufferDetail::buffer and any @c BufferDetail::svm_ptr allocation.
+void releaseBuffer(BufferDetail &imp);
 uint8_t *pin(BufferDetail &imp, PinMode mode);
 /// Unpin memory. Supports asynchronous unpinning by providing a queue, in which case
 /// a @p completion event is also recommended.
@@ -12,6 +12,8 @@
 #include <clu/clu.h>
 #include <clu/cluConstraint.h>
 
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 #include <vector>
 
@@ -77,6 +79,12 @@ void finaliseDetail(DeviceDetail &detail, const DeviceInfo *info)
     clu::printDeviceInfo(str, detail.device, "");
     detail.description = str.str();
   }
+
+  const char *cache_dir = std::getenv("GPUTIL_PROGRAM_CACHE");
+  if (cache_dir && detail.program_cache_dir.empty())
+  {
+    detail.program_cache_dir = cache_dir;
+  }
 }
 
 
@@ -340,7 +348,10 @@ bool Device::select(int argc, const char **argv, const char *default_device, uns
             setDebugGpu(DebugLevel(level));
           }
         }
-        break;
+      }
+      else if (strstr(argv[i], "--gpu-cache=") == argv[i])
+      {
+        setProgramCacheDir(argv[i] + strlen("--gpu-cache="));
       }
     }
 
@@ -388,6 +399,34 @@ bool Device::select(const DeviceInfo &device_info)
 }
 
 
+bool Device::selectIndex(unsigned device_index)
+{
+  std::vector<cl::Device> devices;
+  std::vector<DeviceInfo> infos;
+  gputil::enumerateDevices(devices, infos);
+
+  if (device_index >= devices.size() || device_index >= infos.size())
+  {
+    return false;
+  }
+
+  imp_->device = devices[device_index];
+  imp_->context = cl::Context(imp_->device);
+  imp_->default_queue = createQueue();
+  finaliseDetail(*imp_, &infos[device_index]);
+  if (isValid())
+  {
+    cl::Context context;
+    cl::Device device;
+    if (!clu::getPrimaryContext(context, device))
+    {
+      clu::setPrimaryContext(imp_->context, imp_->device);
+    }
+  }
+  return isValid();
+}
+
+
 void Device::setDebugGpu(DebugLevel debug_level)
 {
   if (imp_)
@@ -432,6 +471,21 @@ const char *Device::searchPaths() const
 }
 
 
+void Device::setProgramCacheDir(const char *path)
+{
+  if (imp_)
+  {
+    imp_->program_cache_dir = (path) ? path : "";
+  }
+}
+
+
+const char *Device::programCacheDir() const
+{
+  return (imp_) ? imp_->program_cache_dir.c_str() : "";
+}
+
+
 bool Device::isValid() const
 {
   return imp_ && imp_->context();
@@ -479,6 +533,16 @@ bool Device::unifiedMemory() const
 }
 
 
+bool Device::operator==(const Device &other) const
+{
+  if (!imp_ || !other.imp_)
+  {
+    return imp_ == other.imp_;
+  }
+  return imp_->device() == other.imp_->device() && imp_->context() == other.imp_->context();
+}
+
+
 Device &Device::operator=(const Device &other)
 {
   if (this != &other)
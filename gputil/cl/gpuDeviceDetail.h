@@ -25,6 +25,7 @@ struct DeviceDetail
   DeviceInfo info;
   std::string description;
   std::string search_paths;
+  std::string program_cache_dir;  ///< Directory for caching compiled program binaries. Empty to disable.
   std::string extensions;  ///< OpenCL supported extension string.
   unsigned debug = 0;
 };
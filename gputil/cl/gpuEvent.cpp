@@ -87,6 +87,34 @@ void Event::wait() const
 }
 
 
+bool Event::timing(EventTiming *timing) const
+{
+  if (!imp_ || !imp_->event)
+  {
+    return false;
+  }
+
+  wait();
+
+  cl_ulong queued = 0;
+  cl_ulong start = 0;
+  cl_ulong end = 0;
+  // Profiling info is not available unless the queue was created with CL_QUEUE_PROFILING_ENABLE. Fail silently as that
+  // is an expected case.
+  if (clGetEventProfilingInfo(imp_->event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, nullptr) !=
+        CL_SUCCESS ||
+      clGetEventProfilingInfo(imp_->event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) != CL_SUCCESS ||
+      clGetEventProfilingInfo(imp_->event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) != CL_SUCCESS)
+  {
+    return false;
+  }
+
+  timing->wait_ns = (start > queued) ? uint64_t(start - queued) : 0u;
+  timing->exec_ns = (end > start) ? uint64_t(end - start) : 0u;
+  return true;
+}
+
+
 void Event::wait(const Event *events, size_t event_count)
 {
   if (event_count)
@@ -6,17 +6,23 @@
 #include "gpuProgram.h"
 
 #include "gpuDeviceDetail.h"
+#include "gpuProgramCache.h"
 #include "gpuProgramDetail.h"
 
 #include <clu/cluProgram.h>
 
 #include <algorithm>
+#include <array>
+#include <cstring>
 #include <sstream>
 
 namespace gputil
 {
 namespace
 {
+/// Maximum source path length when resolving source files for the program cache.
+const size_t kMaxPath = 2048u;
+
 void prepareDebugBuildArgs(const gputil::Device &gpu, const BuildArgs &build_args, std::ostream &debug_opt,
                            std::ostream &build_opt, std::string &source_file_opt)
 {
@@ -150,6 +156,33 @@ int Program::buildFromFile(const char *file_name, const BuildArgs &build_args)
   prepareDebugBuildArgs(imp_->device, build_args, debug_opt, build_opt, source_file_opt);
 
   std::string source_file_name(file_name);
+
+  // Try the binary cache. Resolve the source directory as clu::buildProgramFromFile() does so the cache key can
+  // include the source and the files it includes.
+  ProgramCache cache(*imp_->device.detail(), programName());
+  bool cacheable = false;
+  if (cache.isEnabled())
+  {
+    std::array<char, kMaxPath> source_dir{};
+    strncpy(source_dir.data(), file_name, source_dir.size() - 1);
+    if (clu::findProgramDir(source_dir.data(), source_dir.size(), imp_->device.searchPaths()))
+    {
+      const std::string include_dir(source_dir.data());
+      cacheable = cache.addSourceFile(include_dir + char(clu::pathSeparator()) + file_name, include_dir);
+    }
+
+    if (cacheable)
+    {
+      cache.addOptions(debug_opt.str());
+      cache.addOptions(build_opt.str());
+      cache.addOptions(source_file_opt);
+      if (cache.load(imp_->program, build_opt.str() + ' ' + debug_opt.str()))
+      {
+        return CL_SUCCESS;
+      }
+    }
+  }
+
   cl_int clerr =
     clu::buildProgramFromFile(imp_->program, ocl_context, source_file_name, std::cerr, build_opt.str().c_str(),
                               debug_opt.str().c_str(), source_file_opt.c_str(), imp_->device.searchPaths());
@@ -160,6 +193,11 @@ int Program::buildFromFile(const char *file_name, const BuildArgs &build_args)
     return clerr;
   }
 
+  if (cacheable)
+  {
+    cache.save(imp_->program);
+  }
+
   return clerr;
 }
 
@@ -172,6 +210,23 @@ int Program::buildFromSource(const char *source, size_t source_length, const Bui
   cl::Context &ocl_context = imp_->device.detail()->context;
   prepareDebugBuildArgs(imp_->device, build_args, debug_opt, build_opt, source_file_opt);
 
+  if (source_length == 0)
+  {
+    source_length = strlen(source);
+  }
+
+  ProgramCache cache(*imp_->device.detail(), programName());
+  if (cache.isEnabled())
+  {
+    cache.addSource(source, source_length);
+    cache.addOptions(debug_opt.str());
+    cache.addOptions(build_opt.str());
+    if (cache.load(imp_->program, build_opt.str() + ' ' + debug_opt.str()))
+    {
+      return CL_SUCCESS;
+    }
+  }
+
   cl_int clerr = clu::buildProgramFromString(imp_->program, ocl_context, source, source_length, std::cerr,
                                              programName(), build_opt.str().c_str(), debug_opt.str().c_str());
 
@@ -182,6 +237,8 @@ int Program::buildFromSource(const char *source, size_t source_length, const Bui
     return clerr;
   }
 
+  cache.save(imp_->program);
+
   return clerr;
 }
 
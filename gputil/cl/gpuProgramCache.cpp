@@ -0,0 +1,295 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpuProgramCache.h"
+
+#include "gpuDeviceDetail.h"
+
+#include <clu/cluProgram.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace gputil
+{
+namespace
+{
+/// Cache file marker: "GPCB" .
+const uint32_t kCacheMarker = 0x42435047u;
+/// Cache file format version.
+const uint32_t kCacheVersion = 1u;
+
+const uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+const uint64_t kFnvPrime = 0x100000001b3ull;
+
+/// Cache file header preceding the program binary.
+struct CacheHeader
+{
+  uint32_t marker;
+  uint32_t version;
+  uint64_t key;
+  uint64_t binary_size;
+};
+
+std::string directoryOf(const std::string &path)
+{
+  const size_t sep = path.find_last_of("/\\");
+  return (sep != std::string::npos) ? path.substr(0, sep) : std::string(".");
+}
+
+std::string joinPath(const std::string &dir, const std::string &file)
+{
+  if (dir.empty() || dir.back() == '/' || dir.back() == '\\')
+  {
+    return dir + file;
+  }
+  return dir + char(clu::pathSeparator()) + file;
+}
+
+/// Extract the file name from a line of the form `#include "file"` , allowing for leading white space.
+bool parseInclude(const std::string &line, std::string &include_file)
+{
+  size_t pos = line.find_first_not_of(" \t");
+  if (pos == std::string::npos || line[pos] != '#')
+  {
+    return false;
+  }
+  pos = line.find_first_not_of(" \t", pos + 1);
+  if (pos == std::string::npos || line.compare(pos, 7, "include") != 0)
+  {
+    return false;
+  }
+  const size_t open = line.find('"', pos + 7);
+  const size_t close = (open != std::string::npos) ? line.find('"', open + 1) : std::string::npos;
+  if (close == std::string::npos)
+  {
+    return false;
+  }
+  include_file = line.substr(open + 1, close - open - 1);
+  return true;
+}
+}  // namespace
+
+
+ProgramCache::ProgramCache(const DeviceDetail &device, const char *program_name)
+  : device_(device)
+  , cache_dir_(device.program_cache_dir)
+  , program_name_(program_name)
+  , key_(kFnvOffset)
+{
+  if (!isEnabled())
+  {
+    return;
+  }
+
+  std::string info;
+  device.device.getInfo(CL_DEVICE_NAME, &info);
+  addOptions(info);
+  device.device.getInfo(CL_DEVICE_VERSION, &info);
+  addOptions(info);
+  device.device.getInfo(CL_DRIVER_VERSION, &info);
+  addOptions(info);
+  cl_platform_id platform_id{};
+  device.device.getInfo(CL_DEVICE_PLATFORM, &platform_id);
+  cl::Platform platform(platform_id);
+  platform.getInfo(CL_PLATFORM_NAME, &info);
+  addOptions(info);
+  platform.getInfo(CL_PLATFORM_VERSION, &info);
+  addOptions(info);
+  addOptions(program_name_);
+}
+
+
+void ProgramCache::addSource(const char *source, size_t length)
+{
+  addBytes(source, length);
+}
+
+
+bool ProgramCache::addSourceFile(const std::string &path, const std::string &include_dir)
+{
+  std::unordered_set<std::string> visited;
+  return addSourceFileRecursive(path, include_dir, visited);
+}
+
+
+void ProgramCache::addOptions(const std::string &options)
+{
+  // Include the terminator to separate consecutive items.
+  addBytes(options.c_str(), options.size() + 1);
+}
+
+
+std::string ProgramCache::path() const
+{
+  std::ostringstream str;
+  str << program_name_ << '-' << std::hex << std::setw(16) << std::setfill('0') << key_ << ".bin";
+  return joinPath(cache_dir_, str.str());
+}
+
+
+bool ProgramCache::load(cl::Program &program, const std::string &build_options) const
+{
+  if (!isEnabled())
+  {
+    return false;
+  }
+
+  std::ifstream in(path(), std::ios::binary);
+  if (!in.is_open())
+  {
+    return false;
+  }
+
+  CacheHeader header{};
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (!in.good() || header.marker != kCacheMarker || header.version != kCacheVersion || header.key != key_ ||
+      header.binary_size == 0)
+  {
+    return false;
+  }
+
+  std::vector<unsigned char> binary(header.binary_size);
+  in.read(reinterpret_cast<char *>(binary.data()),  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+          std::streamsize(binary.size()));
+  if (!in.good())
+  {
+    return false;
+  }
+
+  const std::vector<cl::Device> devices = { device_.device };
+  const cl::Program::Binaries binaries = { std::move(binary) };
+  cl_int clerr = CL_SUCCESS;
+  cl::Program local_program(device_.context, devices, binaries, nullptr, &clerr);
+  if (clerr != CL_SUCCESS)
+  {
+    return false;
+  }
+
+  clerr = local_program.build(devices, build_options.c_str());
+  if (clerr != CL_SUCCESS)
+  {
+    // Stale or incompatible binary. The caller rebuilds from source and replaces it.
+    return false;
+  }
+
+  program = local_program;
+  return true;
+}
+
+
+bool ProgramCache::save(const cl::Program &program) const
+{
+  if (!isEnabled())
+  {
+    return false;
+  }
+
+  cl_int clerr = CL_SUCCESS;
+  const std::vector<cl::Device> devices = program.getInfo<CL_PROGRAM_DEVICES>(&clerr);
+  const cl::Program::Binaries binaries = program.getInfo<CL_PROGRAM_BINARIES>(&clerr);
+  if (clerr != CL_SUCCESS)
+  {
+    return false;
+  }
+
+  const std::vector<unsigned char> *binary = nullptr;
+  for (size_t i = 0; i < devices.size() && i < binaries.size(); ++i)
+  {
+    if (devices[i]() == device_.device())
+    {
+      binary = &binaries[i];
+      break;
+    }
+  }
+
+  if (!binary || binary->empty())
+  {
+    return false;
+  }
+
+  // Write to a temporary file and rename so concurrent processes never read a partial binary.
+  const std::string cache_path = path();
+  const std::string temp_path = cache_path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+      std::cerr << "Failed to write GPU program cache file: " << temp_path << std::endl;
+      return false;
+    }
+
+    const CacheHeader header = { kCacheMarker, kCacheVersion, key_, uint64_t(binary->size()) };
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));  // NOLINT
+    out.write(reinterpret_cast<const char *>(binary->data()),            // NOLINT
+              std::streamsize(binary->size()));
+    if (!out.good())
+    {
+      out.close();
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  std::remove(cache_path.c_str());
+  if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0)
+  {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+void ProgramCache::addBytes(const void *bytes, size_t byte_count)
+{
+  const auto *data = static_cast<const unsigned char *>(bytes);
+  for (size_t i = 0; i < byte_count; ++i)
+  {
+    key_ ^= data[i];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    key_ *= kFnvPrime;
+  }
+}
+
+
+bool ProgramCache::addSourceFileRecursive(const std::string &path, const std::string &include_dir,
+                                          std::unordered_set<std::string> &visited)
+{
+  if (!visited.insert(path).second)
+  {
+    // Already included.
+    return true;
+  }
+
+  std::ifstream in(path);
+  if (!in.is_open())
+  {
+    return false;
+  }
+
+  const std::string local_dir = directoryOf(path);
+  std::string line;
+  std::string include_file;
+  while (std::getline(in, line))
+  {
+    addOptions(line);
+    if (parseInclude(line, include_file))
+    {
+      // Missing includes are left for the compiler to report.
+      if (!addSourceFileRecursive(joinPath(local_dir, include_file), include_dir, visited))
+      {
+        addSourceFileRecursive(joinPath(include_dir, include_file), include_dir, visited);
+      }
+    }
+  }
+
+  return true;
+}
+}  // namespace gputil
@@ -0,0 +1,83 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef GPUPROGRAMCACHE_H
+#define GPUPROGRAMCACHE_H
+
+#include "gpuConfig.h"
+
+#include <clu/clu.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+namespace gputil
+{
+struct DeviceDetail;
+
+/// Resolves and maintains the on disk binary cache entry for an OpenCL program. See @c Device::setProgramCacheDir() .
+///
+/// The cache key is a hash of the device name, device version, driver and platform versions, the program name,
+/// sources and build options. Sources are added with @c addSource() or @c addSourceFile() , the latter also hashing
+/// any files included via `#include "file"` . Once all inputs are added, @c load() attempts to create the program from
+/// a cached binary, while @c save() writes the binary for a newly built program.
+class ProgramCache
+{
+public:
+  /// Create a cache entry for @p program_name on @p device . The entry is disabled when the device has no
+  /// @c Device::programCacheDir() .
+  /// @param device The target device.
+  /// @param program_name The program reference name.
+  ProgramCache(const DeviceDetail &device, const char *program_name);
+
+  /// Is the cache enabled?
+  /// @return True when a cache directory is set.
+  inline bool isEnabled() const { return !cache_dir_.empty(); }
+
+  /// Add program source to the key.
+  /// @param source The source string.
+  /// @param length The number of characters in @p source .
+  void addSource(const char *source, size_t length);
+
+  /// Add the content of a source file to the key, along with any files it includes using quotes. Includes are
+  /// resolved relative to the including file, then relative to @p include_dir .
+  /// @param path The path of the source file.
+  /// @param include_dir The primary include directory.
+  /// @return False if @p path cannot be read.
+  bool addSourceFile(const std::string &path, const std::string &include_dir);
+
+  /// Add build options to the key.
+  /// @param options The options string.
+  void addOptions(const std::string &options);
+
+  /// Resolve the cache file path for the current key.
+  /// @return The cache file path.
+  std::string path() const;
+
+  /// Try create @p program from a cached binary, building it with @p build_options .
+  /// @param[out] program The program to create. Unchanged on failure.
+  /// @param build_options Build options for linking the binary.
+  /// @return True if @p program has been loaded from the cache.
+  bool load(cl::Program &program, const std::string &build_options) const;
+
+  /// Write the binary for the built @p program to the cache. Failures are ignored other than logging.
+  /// @param program The built program.
+  /// @return True on success.
+  bool save(const cl::Program &program) const;
+
+private:
+  void addBytes(const void *bytes, size_t byte_count);
+  bool addSourceFileRecursive(const std::string &path, const std::string &include_dir,
+                              std::unordered_set<std::string> &visited);
+
+  const DeviceDetail &device_;
+  std::string cache_dir_;
+  std::string program_name_;
+  uint64_t key_;
+};
+}  // namespace gputil
+
+#endif  // GPUPROGRAMCACHE_H
@@ -126,12 +126,19 @@ inline __device__ bool gputilAtomicCasF32(atomic_float *obj, float expected, flo
   return __int_as_float(atomicCAS((atomic_int *)obj, __float_as_int(expected), __float_as_int(desired))) == expected;
 }
 
+/// Atomic float addition. This is native in CUDA, where OpenCL requires a compare and swap loop.
+inline __device__ float gputilAtomicAddF32(atomic_float *obj, float val)
+{
+  return atomicAdd(obj, val);
+}
+
 
 #define gputilAtomicInitF32L gputilAtomicInitF32
 #define gputilAtomicStoreF32L gputilAtomicStoreF32
 #define gputilAtomicLoadF32L gputilAtomicLoadF32
 #define gputilAtomicExchangeF32L gputilAtomicExchangeF32
 #define gputilAtomicCasF32L gputilAtomicCasF32
+#define gputilAtomicAddF32L gputilAtomicAddF32
 
 // Note: CUDA semantics for atomicInc/Dec differ from OpenCL atomic_inc/dec. We use the OpenCL semantics, where there
 // is no validation value and always increments/decrements.
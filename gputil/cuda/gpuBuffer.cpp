@@ -59,6 +59,12 @@ bool bufferCopy(void *dst, const void *src, size_t byte_count, cudaMemcpyKind ki
       GPUAPICHECK(err, cudaSuccess, true);
     }
 
+    if (completion && queue->internal()->profile)
+    {
+      err = recordEventStart(*completion, stream);
+      GPUAPICHECK(err, cudaSuccess, true);
+    }
+
     err = cudaMemcpyAsync(dst, src, byte_count, kind, stream);
     GPUAPICHECK(err, cudaSuccess, true);
 
@@ -98,7 +104,8 @@ uint8_t *pin(BufferDetail &buf, PinMode mode)
 
   if (buf.mapped_mem)
   {
-    if (mode == kPinRead || mode == kPinReadWrite)
+    // Unified memory is shared with the device, so there is nothing to copy.
+    if ((mode == kPinRead || mode == kPinReadWrite) && !(buf.flags & kBfUnified))
     {
       // Copy from host.
       // Currently only support synchronous mem copy.
@@ -141,13 +148,25 @@ void unpin(BufferDetail &imp, void *pinned_ptr, PinMode mode, Queue *queue, Even
   }
 
   cudaError_t err = cudaSuccess;
-  if (expected_pin_flags & kPinnedForWrite)
+  if ((expected_pin_flags & kPinnedForWrite) && (imp.flags & kBfUnified))
+  {
+    // Unified memory writes are already visible to the device.
+    imp.dirty_write.clear();
+  }
+  else if (expected_pin_flags & kPinnedForWrite)
   {
     // Process the dirty list, copying regions back to the device.
     MemRegion::mergeRegionList(imp.dirty_write);
 
     // Process the merged dirty list.
     bool async = false;
+    if (completion && queue && !queue->internal()->force_synchronous && queue->internal()->profile &&
+        !imp.dirty_write.empty())
+    {
+      // Time all the copies as one command.
+      err = recordEventStart(*completion, queue->internal()->queue);
+      GPUAPICHECK2(err, cudaSuccess);
+    }
     for (const MemRegion &region : imp.dirty_write)
     {
       if (region.byte_count)
@@ -203,6 +222,12 @@ bool bufferSet(void *mem, int value, size_t count, Queue *queue, Event *block_on
       GPUAPICHECK(err, cudaSuccess, true);
     }
 
+    if (completion && queue->internal()->profile)
+    {
+      err = recordEventStart(*completion, stream);
+      GPUAPICHECK(err, cudaSuccess, true);
+    }
+
     err = cudaMemsetAsync(mem, value, count, stream);
     GPUAPICHECK(err, cudaSuccess, true);
 
@@ -237,6 +262,28 @@ cudaError_t bufferAlloc(BufferDetail *buf, size_t alloc_size)
   cudaError_t err = cudaSuccess;
 
   logutil::trace("gputil::gpuBuffer: allocating ", logutil::Bytes(alloc_size, logutil::ByteMagnitude::kByte));
+  if (buf->flags & kBfUnified)
+  {
+    // Zero copy host memory mapped into the device address space. Unlike managed memory, this supports host access
+    // while kernels are running on devices without concurrent managed access, such as Jetson.
+    err = cudaHostAlloc(&buf->mapped_mem, alloc_size, cudaHostAllocMapped);
+    if (err == cudaSuccess)
+    {
+      err = cudaHostGetDevicePointer(&buf->device_mem, buf->mapped_mem, 0);
+      if (err == cudaSuccess)
+      {
+        buf->alloc_size = alloc_size;
+        return err;
+      }
+      cudaFreeHost(buf->mapped_mem);
+      buf->mapped_mem = nullptr;
+      buf->device_mem = nullptr;
+    }
+
+    // Not supported. Fall back to device memory.
+    buf->flags &= ~kBfUnified;
+  }
+
   err = cudaMalloc(&buf->device_mem, alloc_size);
 
   if (err == cudaSuccess)
@@ -270,7 +317,11 @@ void bufferFree(BufferDetail *buf)
   if (buf && buf->device_mem)
   {
     logutil::trace("gputil::gpuBuffer freeing ", logutil::Bytes(buf->alloc_size, logutil::ByteMagnitude::kByte));
-    cudaFree(buf->device_mem);
+    if (!(buf->flags & kBfUnified))
+    {
+      // Unified device memory is the mapped_mem freed below.
+      cudaFree(buf->device_mem);
+    }
     if (buf->mapped_mem)
     {
       cudaFreeHost(buf->mapped_mem);
@@ -580,6 +631,12 @@ size_t Buffer::writeElements(const void *src, size_t element_size, size_t elemen
 }
 
 
+void *Buffer::hostPointer() const
+{
+  return (imp_->flags & kBfUnified) ? imp_->mapped_mem : nullptr;
+}
+
+
 void *Buffer::argPtr() const
 {
   return &imp_->device_mem;
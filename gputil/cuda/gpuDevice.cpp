@@ -7,6 +7,7 @@
 #include "gputil/gpuDevice.h"
 
 #include "gputil/cuda/gpuDeviceDetail.h"
+#include "gputil/cuda/gpuQueueDetail.h"
 
 #include "gputil/gpuApiException.h"
 #include "gputil/gpuThrow.h"
@@ -147,7 +148,7 @@ Queue Device::defaultQueue() const
 }
 
 
-Queue Device::createQueue(unsigned /*flags*/) const
+Queue Device::createQueue(unsigned flags) const
 {
   cudaStream_t stream = nullptr;
   cudaError_t err;
@@ -155,7 +156,9 @@ Queue Device::createQueue(unsigned /*flags*/) const
   GPUAPICHECK(err, cudaSuccess, Queue());
   err = cudaStreamCreate(&stream);
   GPUAPICHECK(err, cudaSuccess, Queue());
-  return Queue(stream);
+  Queue queue(stream);
+  queue.internal()->profile = (flags & Queue::kProfile) != 0;
+  return queue;
 }
 
 
@@ -298,6 +301,20 @@ bool Device::select(const DeviceInfo &device_info)
 }
 
 
+bool Device::selectIndex(unsigned device_index)
+{
+  int device_count = 0;
+  cudaGetDeviceCount(&device_count);
+
+  if (int(device_index) >= device_count)
+  {
+    return false;
+  }
+
+  return selectDevice(*imp_, int(device_index));
+}
+
+
 // Lint(KS): required for API compatibility
 // NOLINTNEXTLINE(readability-convert-member-functions-to-static)
 void Device::setDebugGpu(DebugLevel /*level*/)
@@ -339,6 +356,22 @@ const char *Device::searchPaths() const
 }
 
 
+// Lint(KS): required for API compatibility
+// NOLINTNEXTLINE(readability-convert-member-functions-to-static)
+void Device::setProgramCacheDir(const char * /*path*/)
+{
+  // Ignored for CUDA.
+}
+
+
+// Lint(KS): required for API compatibility
+// NOLINTNEXTLINE(readability-convert-member-functions-to-static)
+const char *Device::programCacheDir() const
+{
+  return "";
+}
+
+
 bool Device::isValid() const
 {
   return imp_ && imp_->device >= 0;
@@ -374,6 +407,17 @@ bool Device::unifiedMemory() const
 }
 
 
+bool Device::operator==(const Device &other) const
+{
+  if (!imp_ || !other.imp_)
+  {
+    return imp_ == other.imp_;
+  }
+  // CUDA uses the primary context for each device, so the device ID is sufficient.
+  return imp_->device == other.imp_->device;
+}
+
+
 Device &Device::operator=(const Device &other)
 {
   if (this != &other)
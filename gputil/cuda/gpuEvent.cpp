@@ -13,6 +13,8 @@
 #include <cuda.h>
 #include <cuda_runtime.h>
 
+#include <memory>
+
 namespace gputil
 {
 void destroyEvent(cudaEvent_t event)
@@ -25,6 +27,28 @@ void destroyEvent(cudaEvent_t event)
   }
 }
 
+cudaError_t recordEventStart(Event &event, cudaStream_t stream)
+{
+  event.release();
+  EventDetail *detail = event.detail();
+  if (!detail)
+  {
+    return cudaErrorInvalidResourceHandle;
+  }
+
+  if (!*detail->start_event)
+  {
+    cudaError_t err = cudaEventCreateWithFlags(detail->start_event, cudaEventBlockingSync);
+    if (err != cudaSuccess)
+    {
+      return err;
+    }
+  }
+
+  return cudaEventRecord(*detail->start_event, stream);
+}
+
+
 Event::Event() = default;
 
 Event::Event(const Event &other)
@@ -98,6 +122,30 @@ void Event::wait() const
 }
 
 
+bool Event::timing(EventTiming *timing) const
+{
+  if (!isValid() || !imp_->start_event || !*imp_->start_event)
+  {
+    // Not recorded on a profiling queue.
+    return false;
+  }
+
+  wait();
+
+  float elapsed_ms = 0;
+  cudaError_t err = cudaEventElapsedTime(&elapsed_ms, *imp_->start_event, imp_->obj());
+  if (err != cudaSuccess)
+  {
+    return false;
+  }
+
+  // CUDA does not expose the time spent queued.
+  timing->wait_ns = 0;
+  timing->exec_ns = uint64_t(double(elapsed_ms) * 1e6);
+  return true;
+}
+
+
 void Event::wait(const Event *events, size_t event_count)
 {
   for (size_t i = 0; i < event_count; ++i)
@@ -149,7 +197,13 @@ EventDetail *Event::detail()
     cudaEvent_t event = nullptr;
     cudaError_t err = cudaEventCreateWithFlags(&event, cudaEventBlockingSync);
     GPUAPICHECK(err, cudaSuccess, nullptr);
-    imp_ = new EventDetail(event, 1, &destroyEvent);  // NOLINT(cppcoreguidelines-owning-memory)
+    // The profiling start marker is only created on demand, but its storage must be released along with the event.
+    auto start_event = std::make_shared<cudaEvent_t>(nullptr);
+    imp_ = new EventDetail(event, 1, [start_event](cudaEvent_t &obj) {  // NOLINT(cppcoreguidelines-owning-memory)
+      destroyEvent(obj);
+      destroyEvent(*start_event);
+    });
+    imp_->start_event = start_event.get();
   }
   return imp_;
 }
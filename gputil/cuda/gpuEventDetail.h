@@ -16,10 +16,24 @@
 
 namespace gputil
 {
+class Event;
+
 void destroyEvent(cudaEvent_t event);
 
+/// Record the start marker for timing the next command queued on @p stream , completing with @p event . This releases
+/// the current @p event so the start and completion markers refer to the same command. Only used for profiling queues.
+/// See @c Event::timing() .
+/// @param event The completion event for the command to time.
+/// @param stream The stream on which the command is to be queued.
+/// @return The CUDA error code.
+cudaError_t recordEventStart(Event &event, cudaStream_t stream);
+
 struct EventDetail : public Ref<cudaEvent_t>
 {
+  /// Start marker used to time the command completing this event. Null unless recorded by @c recordEventStart() . The
+  /// marker storage is owned by the release function, which destroys it along with the completion event.
+  cudaEvent_t *start_event = nullptr;
+
   inline EventDetail(cudaEvent_t obj, unsigned initial_ref_count, const ReleaseFunc &release)
     : Ref<cudaEvent_t>(obj, initial_ref_count, release)
   {}
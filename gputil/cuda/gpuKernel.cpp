@@ -104,6 +104,14 @@ int invokeKernel(const KernelDetail &imp, const Dim3 &global_size, const Dim3 &l
 
   // args = dummy_args.data();
 
+  // Mark the kernel start for profiling queues.
+  const bool profile = completion_event && queue && queue->internal()->profile;
+  if (profile)
+  {
+    err = recordEventStart(*completion_event, cuda_stream);
+    GPUAPICHECK(err, cudaSuccess, err);
+  }
+
   // Launch kernel.
   dim3 grid_dim;
   grid_dim.x = (local_size.x) ? unsigned((global_size.x + local_size.x - 1) / local_size.x) : 1u;
@@ -117,8 +125,11 @@ int invokeKernel(const KernelDetail &imp, const Dim3 &global_size, const Dim3 &l
   // Hook up completion event.
   if (completion_event)
   {
-    // Create new event.
-    completion_event->release();
+    // Create new event. The profiling path has already done so with the start marker.
+    if (!profile)
+    {
+      completion_event->release();
+    }
     err = cudaEventRecord(completion_event->detail()->obj(), cuda_stream);
     GPUAPICHECK(err, cudaSuccess, err);
   }
@@ -21,6 +21,9 @@ struct QueueDetail
 {
   cudaStream_t queue = nullptr;
   bool force_synchronous = false;
+  /// Record start markers for commands so their completion events support @c Event::timing() . Set for queues
+  /// created with @c Queue::kProfile .
+  bool profile = false;
 
   inline ~QueueDetail()
   {
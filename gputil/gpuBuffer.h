@@ -30,6 +30,13 @@ enum BufferFlag : unsigned
   /// Buffer is in host accessible memory on the device.
   /// Required for buffer pinning.
   kBfHostAccess = (1u << 2u),
+  /// Buffer memory is shared by the host and device, directly accessible via @c Buffer::hostPointer() without
+  /// transfer or pinning. Uses OpenCL fine grain buffer SVM, or mapped (zero copy) host memory for CUDA. This flag is
+  /// removed from @c Buffer::flags() when not supported, in which case the buffer is allocated as normal.
+  ///
+  /// Host access is not ordered with respect to device queues. The caller must wait on the events for device
+  /// operations using the memory before accessing it on host and vice versa.
+  kBfUnified = (1u << 3u),
 
   /// Alias for combining read/write flags.
   kBfReadWrite = kBfRead | kBfWrite,
@@ -405,6 +412,14 @@ public:
                          completion);
   }
 
+  /// Host address of the buffer memory for a buffer created with @c kBfUnified .
+  ///
+  /// The memory may be read and written directly, but the caller is responsible for synchronising with device
+  /// operations using the buffer. See @c kBfUnified .
+  ///
+  /// @return The host address of the buffer memory or null if the buffer is not unified.
+  void *hostPointer() const;
+
   /// Internal pointer for argument passing to the device function/kernel.
   ///
   /// For CUDA this is a pointer to a pointer at which which the device memory is made.
@@ -108,6 +108,7 @@ public:
   /// - "--platform=&lt;like-name&gt;" for a plaform approximately matching the given name.
   /// - "--vendor=&lt;like-name&gt;" for a vendor approximately matching the given name.
   /// - "--gpu-debug[=&lt;level&gt;]" set the @c debugGpu() level. Uses @c DL_Low (1) if no level is specified.
+  /// - "--gpu-cache=&lt;dir&gt;" set the @c programCacheDir() .
   ///
   /// @param argc Number of values in @c argv.
   /// @param argv Argument string to parse.
@@ -128,6 +129,12 @@ public:
   /// @return True on success, false on failure to match @p device_info.
   bool select(const DeviceInfo &device_info);
 
+  /// Select the device at @p device_index in the list generated by @c enumerateDevices() . This supports selecting
+  /// between multiple devices which share the same @c DeviceInfo , such as identical GPUs.
+  /// @param device_index Index of the device to select.
+  /// @return True on success, false when @p device_index is out of range or the device cannot be selected.
+  bool selectIndex(unsigned device_index);
+
   /// Set the value for @c debugGpu().
   /// @param debug_level The @c DebugLevel to set.
   void setDebugGpu(DebugLevel debug_level);
@@ -154,6 +161,23 @@ public:
   /// @return The search paths to be used to find GPU sources.
   const char *searchPaths() const;
 
+  /// Set the directory used to cache compiled GPU programs (OpenCL binaries). An empty or null @p path disables the
+  /// cache.
+  ///
+  /// When set, @c Program builds first look for a binary in this directory keyed on the device, platform and driver
+  /// versions, the program source - including files it includes - and the build options. A new binary is written to
+  /// the directory after building from source. This avoids runtime compilation on subsequent runs. The cache defaults
+  /// to the `GPUTIL_PROGRAM_CACHE` environment variable and may also be set by
+  /// @c select(int, const char **, const char *, unsigned) using "--gpu-cache=&lt;dir&gt;".
+  ///
+  /// This is ignored for CUDA, where GPU code is compiled ahead of time.
+  /// @param path The cache directory. Must exist.
+  void setProgramCacheDir(const char *path);
+
+  /// Query the program binary cache directory. Empty when the cache is disabled.
+  /// @return The program cache directory.
+  const char *programCacheDir() const;
+
   /// Is the device valid?
   /// @return True if valid.
   bool isValid() const;
@@ -180,6 +204,17 @@ public:
   /// @return *this
   Device &operator=(Device &&other) noexcept;
 
+  /// Equality operator. Devices are equal when they reference the same underlying device and API context, such that
+  /// GPU resources may be shared between them. Copies of a @c Device compare equal.
+  /// @param other The device to compare against.
+  /// @return True if this and @p other are the same device.
+  bool operator==(const Device &other) const;
+
+  /// Inequality operator.
+  /// @param other The device to compare against.
+  /// @return True if this and @p other are not the same device.
+  inline bool operator!=(const Device &other) const { return !operator==(other); }
+
   /// Get the internal device representation.
   /// @return The internal device detail.
   DeviceDetail *detail() const { return imp_.get(); }
@@ -9,11 +9,22 @@
 #include "gpuConfig.h"
 
 #include <cstddef>
+#include <cstdint>
 
 namespace gputil
 {
 struct EventDetail;
 
+/// Device timing information for a completed @c Event . See @c Event::timing() .
+struct EventTiming
+{
+  /// Time the command spent queued on the device before execution started (nanoseconds). This measures queue stalls
+  /// and is always zero for CUDA, which does not expose the information.
+  uint64_t wait_ns = 0;
+  /// Command execution time on the device (nanoseconds).
+  uint64_t exec_ns = 0;
+};
+
 /// Marks a point in the execution stream on which we can block and await completion.
 ///
 /// Note: this is analogous to an OpenCL event. CUDA does not have as precise a parallel, supporting only an
@@ -48,6 +59,15 @@ public:
   /// Block until this event to completes.
   void wait() const;
 
+  /// Query the device timing for the command associated with this event, blocking until the event completes.
+  ///
+  /// Timing is only available for commands enqueued on a @c Queue created with @c Queue::kProfile . It is not available
+  /// for invalid events or events from unprofiled or synchronous operations.
+  ///
+  /// @param[out] timing Set to the event timing on success.
+  /// @return True if timing information is available.
+  bool timing(EventTiming *timing) const;
+
   /// Block the CPU on multiple events before continuing.
   ///
   /// An overload accepts an array of pointers.
@@ -0,0 +1,92 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpuProfiler.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace gputil
+{
+Profiler::Profiler() = default;
+
+
+Profiler::~Profiler() = default;
+
+
+void Profiler::record(const std::string &name, const Event &event, size_t bytes)
+{
+  if (!event.isValid())
+  {
+    return;
+  }
+
+  auto stats_iter =
+    std::find_if(stats_.begin(), stats_.end(), [&name](const ProfileStats &stats) { return stats.name == name; });
+  if (stats_iter == stats_.end())
+  {
+    ProfileStats stats;
+    stats.name = name;
+    stats_iter = stats_.insert(stats_.end(), stats);
+  }
+
+  pending_.emplace_back(PendingEvent{ event, size_t(stats_iter - stats_.begin()), bytes });
+}
+
+
+void Profiler::endBatch()
+{
+  ++batch_count_;
+  resolve(false);
+}
+
+
+void Profiler::resolve(bool wait)
+{
+  size_t retained = 0;
+  for (size_t i = 0; i < pending_.size(); ++i)
+  {
+    PendingEvent &pending = pending_[i];
+    if (!wait && !pending.event.isComplete())
+    {
+      // Keep for later resolution.
+      if (retained != i)
+      {
+        pending_[retained] = std::move(pending);
+      }
+      ++retained;
+      continue;
+    }
+
+    EventTiming timing;
+    if (pending.event.timing(&timing))
+    {
+      ProfileStats &stats = stats_[pending.stats_index];
+      ++stats.count;
+      stats.exec_ns += timing.exec_ns;
+      stats.max_exec_ns = std::max(stats.max_exec_ns, timing.exec_ns);
+      stats.wait_ns += timing.wait_ns;
+      stats.bytes += pending.bytes;
+    }
+  }
+
+  pending_.erase(pending_.begin() + std::ptrdiff_t(retained), pending_.end());
+}
+
+
+const std::vector<ProfileStats> &Profiler::stats()
+{
+  resolve(true);
+  return stats_;
+}
+
+
+void Profiler::reset()
+{
+  stats_.clear();
+  pending_.clear();
+  batch_count_ = 0;
+}
+}  // namespace gputil
@@ -0,0 +1,97 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include "gpuConfig.h"
+
+#include "gpuEvent.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gputil
+{
+/// Aggregated device timing for the GPU commands recorded under a common name by a @c Profiler .
+struct ProfileStats
+{
+  /// Name of the command - e.g., a kernel name or transfer type.
+  std::string name;
+  /// Number of commands with timing information.
+  unsigned count = 0;
+  /// Total execution time over all commands (nanoseconds).
+  uint64_t exec_ns = 0;
+  /// Longest single command execution time (nanoseconds).
+  uint64_t max_exec_ns = 0;
+  /// Total time commands spent queued before execution (nanoseconds). Always zero for CUDA.
+  uint64_t wait_ns = 0;
+  /// Total bytes transferred by the commands. Zero for kernels.
+  uint64_t bytes = 0;
+};
+
+/// Collects and aggregates device timing for GPU commands - kernels and transfers - using @c Event::timing() .
+///
+/// GPU code calls @c record() with the completion @c Event for each command of interest and a name identifying the
+/// command type. The events are held pending and resolved into the @c ProfileStats for each name as they complete.
+/// Callers mark the end of each processing batch using @c endBatch() , which resolves completed events without
+/// blocking, so the stats may be reported per batch.
+///
+/// Timing is only available for commands on queues created with @c Queue::kProfile . Events without timing are
+/// silently ignored.
+class gputilAPI Profiler
+{
+public:
+  /// Construct an empty profiler.
+  Profiler();
+  /// Destructor.
+  ~Profiler();
+
+  /// Record the command completing with @p event under @p name . Invalid events are ignored.
+  /// @param name Name identifying the command type.
+  /// @param event Completion event for the command.
+  /// @param bytes Bytes transferred by the command, zero for kernels.
+  void record(const std::string &name, const Event &event, size_t bytes = 0);
+
+  /// Mark the end of a processing batch, resolving the pending events which have completed.
+  void endBatch();
+
+  /// Resolve the pending events into the stats.
+  /// @param wait True to block until all pending events complete. Otherwise only completed events are resolved.
+  void resolve(bool wait);
+
+  /// Query the number of @c endBatch() calls since construction or @c reset() .
+  /// @return The batch count.
+  inline unsigned batchCount() const { return batch_count_; }
+
+  /// Query the number of recorded events yet to be resolved.
+  /// @return The pending event count.
+  inline size_t pendingCount() const { return pending_.size(); }
+
+  /// Resolve all pending events and fetch the aggregated stats, in the order each name was first recorded.
+  /// @return The profile stats.
+  const std::vector<ProfileStats> &stats();
+
+  /// Clear all stats, pending events and the batch count.
+  void reset();
+
+private:
+  /// A recorded event awaiting timing resolution.
+  struct PendingEvent
+  {
+    Event event;
+    size_t stats_index;
+    size_t bytes;
+  };
+
+  std::vector<ProfileStats> stats_;
+  std::vector<PendingEvent> pending_;
+  unsigned batch_count_ = 0;
+};
+}  // namespace gputil
+
+#endif  // GPUPROFILER_H
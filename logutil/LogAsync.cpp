@@ -0,0 +1,325 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace logutil
+{
+// Out of class definitions for ODR use under C++14.
+constexpr size_t LogAsync::kDefaultCapacity;
+constexpr size_t LogAsync::kSlotSize;
+
+namespace
+{
+/// A ring buffer message slot.
+struct LogSlot
+{
+  /// Slot sequence number. Equals the claiming position when free and the position + 1 once the message is written.
+  std::atomic<size_t> sequence{ 0 };
+  LogLevel level = LogLevel::kInfo;
+  bool truncated = false;
+  uint16_t size = 0;
+  uint8_t data[LogAsync::kSlotSize];
+};
+
+
+/// Format arguments encoded by a @c logger_detail::ArgWriter .
+void formatArgs(std::ostream &out, const uint8_t *data, size_t size)
+{
+  using logger_detail::ArgTag;
+  const uint8_t *end = data + size;
+  while (data < end)
+  {
+    const auto tag = ArgTag(*data++);
+    switch (tag)
+    {
+    case ArgTag::kBool:
+      out << (*data++ != 0);
+      break;
+    case ArgTag::kChar:
+      out << char(*data++);
+      break;
+    case ArgTag::kSigned:
+    {
+      int64_t value;
+      std::memcpy(&value, data, sizeof(value));
+      data += sizeof(value);
+      out << value;
+      break;
+    }
+    case ArgTag::kUnsigned:
+    {
+      uint64_t value;
+      std::memcpy(&value, data, sizeof(value));
+      data += sizeof(value);
+      out << value;
+      break;
+    }
+    case ArgTag::kDouble:
+    {
+      double value;
+      std::memcpy(&value, data, sizeof(value));
+      data += sizeof(value);
+      out << value;
+      break;
+    }
+    case ArgTag::kText:
+    {
+      uint16_t length;
+      std::memcpy(&length, data, sizeof(length));
+      data += sizeof(length);
+      out.write(reinterpret_cast<const char *>(data), std::streamsize(length));
+      data += length;
+      break;
+    }
+    default:
+      // Corrupt data.
+      return;
+    }
+  }
+}
+}  // namespace
+
+
+struct LogAsyncDetail
+{
+  LogInterface *target = nullptr;
+  std::unique_ptr<LogSlot[]> slots;
+  size_t capacity = 0;
+  /// Next position for producers to claim.
+  std::atomic<size_t> enqueue_position{ 0 };
+  /// Number of messages passed to the target.
+  std::atomic<size_t> delivered{ 0 };
+  std::atomic<size_t> truncated_count{ 0 };
+  /// Number of threads blocked in @c LogAsync::flush() .
+  std::atomic<unsigned> flush_waiters{ 0 };
+  /// Set while the background thread waits for messages.
+  std::atomic<bool> sleeping{ false };
+  std::atomic<bool> quit{ false };
+  std::mutex mutex;
+  /// Wakes the background thread.
+  std::condition_variable wake;
+  /// Signals @c delivered changes to @c LogAsync::flush() .
+  std::condition_variable delivered_signal;
+  std::thread thread;
+
+  void wakeConsumer()
+  {
+    // Pairs with the fence in run() so either the published message or the sleeping flag is seen.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+    {
+      std::unique_lock<std::mutex> guard(mutex);
+      wake.notify_one();
+    }
+  }
+
+  void notifyDelivered()
+  {
+    // Sequentially consistent with the update of flush_waiters in LogAsync::flush() so a waiter is not missed.
+    if (flush_waiters)
+    {
+      std::unique_lock<std::mutex> guard(mutex);
+      delivered_signal.notify_all();
+    }
+  }
+
+  /// Background thread loop, delivering messages in order.
+  void run()
+  {
+    std::ostringstream out;
+    logger_detail::prepareStream(out);
+    std::string msg;
+    size_t position = 0;
+
+    for (;;)
+    {
+      LogSlot &slot = slots[position & (capacity - 1u)];
+      if (slot.sequence.load(std::memory_order_acquire) == position + 1u)
+      {
+        out.str(std::string());
+        out.clear();
+        formatArgs(out, slot.data, slot.size);
+        if (slot.truncated)
+        {
+          out << "...\n";
+        }
+        const LogLevel level = slot.level;
+        // Release the slot before calling the target so producers blocked on a full buffer may continue.
+        slot.sequence.store(position + capacity, std::memory_order_release);
+        ++position;
+
+        msg = out.str();
+        target->message(level, msg.c_str());
+        delivered = position;
+        notifyDelivered();
+        continue;
+      }
+
+      // Empty, or the next message is still being written.
+      if (quit.load(std::memory_order_acquire) && enqueue_position.load(std::memory_order_acquire) == position)
+      {
+        break;
+      }
+
+      std::unique_lock<std::mutex> guard(mutex);
+      sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (slot.sequence.load(std::memory_order_acquire) != position + 1u && !quit.load(std::memory_order_acquire))
+      {
+        // Producers notify after publishing, so the timeout is only a safeguard.
+        wake.wait_for(guard, std::chrono::milliseconds(100));
+      }
+      sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    std::unique_lock<std::mutex> guard(mutex);
+    delivered_signal.notify_all();
+  }
+};
+
+
+LogAsync::LogAsync(LogInterface *target, size_t capacity)
+  : LogInterface(target->level())
+  , imp_(new LogAsyncDetail)
+{
+  size_t slot_count = 1u;
+  while (slot_count < capacity)
+  {
+    slot_count <<= 1u;
+  }
+
+  imp_->target = target;
+  imp_->capacity = slot_count;
+  imp_->slots = std::make_unique<LogSlot[]>(slot_count);
+  for (size_t i = 0; i < slot_count; ++i)
+  {
+    imp_->slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  imp_->thread = std::thread([this]() { imp_->run(); });
+}
+
+
+LogAsync::~LogAsync()
+{
+  {
+    std::unique_lock<std::mutex> guard(imp_->mutex);
+    imp_->quit = true;
+    imp_->wake.notify_one();
+  }
+  imp_->thread.join();
+  delete imp_;
+}
+
+
+LogInterface *LogAsync::target() const
+{
+  return imp_->target;
+}
+
+
+size_t LogAsync::capacity() const
+{
+  return imp_->capacity;
+}
+
+
+void LogAsync::message(LogLevel level, const char *msg)
+{
+  if (int(level) <= int(this->level()))
+  {
+    uint8_t buffer[kSlotSize];
+    logger_detail::ArgWriter writer(buffer, sizeof(buffer));
+    writer.add(msg);
+    push(level, buffer, writer.size(), writer.truncated());
+    if (level == LogLevel::kFatal)
+    {
+      // A fatal message precedes an exception, which may terminate the program.
+      flush();
+    }
+  }
+}
+
+
+void LogAsync::flush()
+{
+  const size_t position = imp_->enqueue_position.load(std::memory_order_acquire);
+  ++imp_->flush_waiters;
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  imp_->wake.notify_one();
+  imp_->delivered_signal.wait(guard, [this, position]() {
+    return imp_->delivered >= position;
+  });
+  --imp_->flush_waiters;
+}
+
+
+size_t LogAsync::truncatedCount() const
+{
+  return imp_->truncated_count.load(std::memory_order_relaxed);
+}
+
+
+LogAsync *LogAsync::asLogAsync()
+{
+  return this;
+}
+
+
+void LogAsync::push(LogLevel level, const uint8_t *data, size_t size, bool truncated)
+{
+  const size_t mask = imp_->capacity - 1u;
+  size_t position = imp_->enqueue_position.load(std::memory_order_relaxed);
+  LogSlot *slot = nullptr;
+  for (;;)
+  {
+    slot = &imp_->slots[position & mask];
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const auto diff = std::ptrdiff_t(sequence - position);
+    if (diff == 0)
+    {
+      // Slot is free. Try claim it.
+      if (imp_->enqueue_position.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      // Full. Wait for the background thread.
+      imp_->wakeConsumer();
+      std::this_thread::yield();
+      position = imp_->enqueue_position.load(std::memory_order_relaxed);
+    }
+    else
+    {
+      // Claimed by another thread.
+      position = imp_->enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  size = std::min(size, kSlotSize);
+  slot->level = level;
+  slot->truncated = truncated;
+  slot->size = uint16_t(size);
+  std::memcpy(slot->data, data, size);
+  slot->sequence.store(position + 1u, std::memory_order_release);
+
+  if (truncated)
+  {
+    ++imp_->truncated_count;
+  }
+  imp_->wakeConsumer();
+}
+}  // namespace logutil
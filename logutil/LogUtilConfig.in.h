@@ -7,6 +7,9 @@
 
 #include "LogUtilExport.h"
 
+// Messages above this logutil::LogLevel value are removed at compile time.
+#define LOGUTIL_COMPILE_LEVEL @LOGUTIL_COMPILE_LEVEL@
+
 #ifndef _USE_MATH_DEFINES
 #define _USE_MATH_DEFINES
 #endif  // _USE_MATH_DEFINES
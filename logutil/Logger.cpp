@@ -23,6 +23,12 @@ LogInterface::LogInterface(LogLevel level) noexcept
 LogInterface::~LogInterface() = default;
 
 
+LogAsync *LogInterface::asLogAsync()
+{
+  return nullptr;
+}
+
+
 LogOStream::LogOStream(LogLevel level) noexcept
   : LogInterface(level)
 {}
@@ -10,10 +10,21 @@
 
 #include "LoggerDetail.h"
 
+#include <cstddef>
 #include <stdexcept>
+#include <type_traits>
+
+// Messages with a level above this are removed at compile time: the level specific helpers such as @c logutil::trace()
+// compile to nothing. Values match the @c logutil::LogLevel values and are set by the CMake OHM_LOG_COMPILE_LEVEL.
+#ifndef LOGUTIL_COMPILE_LEVEL
+#define LOGUTIL_COMPILE_LEVEL 4
+#endif  // LOGUTIL_COMPILE_LEVEL
 
 namespace logutil
 {
+class LogAsync;
+struct LogAsyncDetail;
+
 /// Logging levels
 enum class LogLevel : int
 {
@@ -29,6 +40,14 @@ enum class LogLevel : int
   kTrace
 };
 
+/// Check if messages at @p level are compiled in, per @c LOGUTIL_COMPILE_LEVEL . Fatal messages are always compiled in.
+/// @param level The level of interest.
+/// @return True if messages at @p level may be logged.
+constexpr bool compiledIn(LogLevel level)
+{
+  return level == LogLevel::kFatal || int(level) <= LOGUTIL_COMPILE_LEVEL;
+}
+
 /// Abstract logging interface.
 class logutil_API LogInterface
 {
@@ -54,6 +73,10 @@ public:
   /// @param level The logging  level.
   inline void setLevel(LogLevel level) { level_ = level; }
 
+  /// Query if this is a @c LogAsync for which the logging helpers should defer formatting.
+  /// @return This object as a @c LogAsync or null.
+  virtual LogAsync *asLogAsync();
+
 private:
   LogLevel level_ = LogLevel::kInfo;  ///< Curent logging level.
 };
@@ -81,6 +104,84 @@ public:
   void message(LogLevel level, const char *msg) override;
 };
 
+/// A logging interface which defers formatting and output to a background thread, forwarding messages to a target
+/// @c LogInterface .
+///
+/// The logging helpers, such as @c info() , copy their arguments into a fixed size slot of a lock free, multiple
+/// producer ring buffer. Arithmetic and string arguments are copied as is, while other types are converted to text in
+/// the calling thread (see @c logger_detail::ArgWriter ). The background thread formats each message and passes it to
+/// the target in the order the slots were claimed. No memory is allocated to log a message unless an argument must be
+/// converted in the calling thread. A message which does not fit a slot is truncated; see @c truncatedCount() .
+/// Callers block when the ring buffer is full.
+///
+/// Messages are delivered asynchronously, so @c flush() should be called where output must be complete, such as
+/// before exiting. Fatal messages are flushed immediately. The destructor delivers all queued messages.
+///
+/// The target is only called from the background thread so it need not be thread safe, but must outlive this object.
+class logutil_API LogAsync : public LogInterface
+{
+public:
+  /// Default number of message slots.
+  static constexpr size_t kDefaultCapacity = 1024u;
+  /// Bytes available for the encoded arguments of each message.
+  static constexpr size_t kSlotSize = 240u;
+
+  /// Constructor, starting the background thread. The @c level() is initialised from the @p target .
+  /// @param target The logging interface to forward messages to. Must not be null.
+  /// @param capacity The number of message slots. Rounded up to a power of two.
+  explicit LogAsync(LogInterface *target, size_t capacity = kDefaultCapacity);
+  /// Destructor: delivers queued messages and stops the background thread.
+  ~LogAsync() override;
+
+  LogAsync(const LogAsync &) = delete;
+  LogAsync &operator=(const LogAsync &) = delete;
+
+  /// Query the target logging interface.
+  /// @return The target.
+  LogInterface *target() const;
+
+  /// Query the number of message slots.
+  /// @return The ring buffer capacity.
+  size_t capacity() const;
+
+  /// Queue a preformatted message. The @p msg is copied.
+  /// @param level The severity of the message.
+  /// @param msg The message to log.
+  void message(LogLevel level, const char *msg) override;
+
+  /// Queue a message to be assembled from @p args on the background thread. Used by the logging helpers. The level is
+  /// not checked.
+  /// @param level The severity of the message.
+  /// @param args Arguments to convert to string and concatenate into a log message.
+  template <typename... Args>
+  inline void post(LogLevel level, Args... args)
+  {
+    uint8_t buffer[kSlotSize];
+    logger_detail::ArgWriter writer(buffer, sizeof(buffer));
+    logger_detail::addArgs(writer, args...);
+    push(level, buffer, writer.size(), writer.truncated());
+  }
+
+  /// Block until all messages queued before this call have been passed to the @c target() .
+  void flush();
+
+  /// Query the number of messages truncated to fit a slot.
+  /// @return The truncated message count.
+  size_t truncatedCount() const;
+
+  LogAsync *asLogAsync() override;
+
+private:
+  /// Copy encoded arguments into the next slot.
+  /// @param level The severity of the message.
+  /// @param data Arguments encoded by an @c logger_detail::ArgWriter .
+  /// @param size The byte size of @p data . Limited to @c kSlotSize .
+  /// @param truncated True if the message has been truncated.
+  void push(LogLevel level, const uint8_t *data, size_t size, bool truncated);
+
+  LogAsyncDetail *imp_;
+};
+
 /// Get the current, global logging output object.
 ///
 /// A @c LogOStream object is installed by default.
@@ -111,6 +212,7 @@ LogInterface logutil_API *defaultLogger();
 /// - @c std::boolalpha
 ///
 /// @note No work is done if the @c logger() is null or the @c logger() level is below the selected message severity.
+/// Formatting is deferred to a background thread when the @p log_interface is a @c LogAsync .
 ///
 /// @param level The message severity.
 /// @param args Arguments to convert to string and concatenate into a log message.
@@ -121,6 +223,12 @@ inline void message(LogInterface *log_interface, LogLevel level, Args... args)
   {
     if (int(log_interface->level()) >= int(level))
     {
+      if (LogAsync *async_logger = log_interface->asLogAsync())
+      {
+        async_logger->post(level, args...);
+        return;
+      }
+
       std::ostringstream out;
       logger_detail::prepareStream(out);
       logger_detail::message(out, args...);
@@ -130,6 +238,26 @@ inline void message(LogInterface *log_interface, LogLevel level, Args... args)
   }
 }
 
+namespace logger_detail
+{
+/// Log a message when @c compiledIn() for the message level.
+template <typename... Args>
+inline void messageIf(std::true_type /* compiled in */, LogInterface *log_interface, LogLevel level, Args... args)
+{
+  message(log_interface, level, args...);
+}
+
+/// Discard a message which is not @c compiledIn() .
+template <typename... Args>
+inline void messageIf(std::false_type /* compiled in */, LogInterface * /* log_interface */, LogLevel /* level */,
+                      Args... /* args */)
+{}
+
+/// Resolves to @c std::true_type when messages at @p kLevel are @c compiledIn() .
+template <LogLevel kLevel>
+using CompiledIn = std::integral_constant<bool, compiledIn(kLevel)>;
+}  // namespace logger_detail
+
 
 /// Log a @c LogLevel::kTrace message using the @c message() function.
 /// @param log_iterface The object to logger to.
@@ -137,7 +265,7 @@ inline void message(LogInterface *log_interface, LogLevel level, Args... args)
 template <typename... Args>
 inline void trace(LogInterface *log_interface, Args... args)
 {
-  message(log_interface, LogLevel::kTrace, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kTrace>(), log_interface, LogLevel::kTrace, args...);
 }
 
 
@@ -146,7 +274,7 @@ inline void trace(LogInterface *log_interface, Args... args)
 template <typename... Args>
 inline void trace(Args... args)
 {
-  message(logger(), LogLevel::kTrace, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kTrace>(), logger(), LogLevel::kTrace, args...);
 }
 
 
@@ -156,7 +284,7 @@ inline void trace(Args... args)
 template <typename... Args>
 inline void info(LogInterface *log_interface, Args... args)
 {
-  message(log_interface, LogLevel::kInfo, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kInfo>(), log_interface, LogLevel::kInfo, args...);
 }
 
 
@@ -165,7 +293,7 @@ inline void info(LogInterface *log_interface, Args... args)
 template <typename... Args>
 inline void info(Args... args)
 {
-  message(logger(), LogLevel::kInfo, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kInfo>(), logger(), LogLevel::kInfo, args...);
 }
 
 
@@ -175,7 +303,7 @@ inline void info(Args... args)
 template <typename... Args>
 inline void warn(LogInterface *log_interface, Args... args)
 {
-  message(log_interface, LogLevel::kWarn, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kWarn>(), log_interface, LogLevel::kWarn, args...);
 }
 
 
@@ -184,7 +312,7 @@ inline void warn(LogInterface *log_interface, Args... args)
 template <typename... Args>
 inline void warn(Args... args)
 {
-  message(logger(), LogLevel::kWarn, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kWarn>(), logger(), LogLevel::kWarn, args...);
 }
 
 
@@ -194,7 +322,7 @@ inline void warn(Args... args)
 template <typename... Args>
 inline void error(LogInterface *log_interface, Args... args)
 {
-  message(log_interface, LogLevel::kError, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kError>(), log_interface, LogLevel::kError, args...);
 }
 
 
@@ -203,7 +331,7 @@ inline void error(LogInterface *log_interface, Args... args)
 template <typename... Args>
 inline void error(Args... args)
 {
-  message(logger(), LogLevel::kError, args...);
+  logger_detail::messageIf(logger_detail::CompiledIn<LogLevel::kError>(), logger(), LogLevel::kError, args...);
 }
 
 
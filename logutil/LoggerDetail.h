@@ -8,10 +8,14 @@
 
 #include "LogUtilConfig.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <locale>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 namespace logutil
 {
@@ -41,6 +45,195 @@ inline void message(std::ostream &stream, const T &value, Args... args)
   stream << value;
   message(stream, args...);
 }
+
+/// Argument types encoded by an @c ArgWriter .
+enum class ArgTag : uint8_t
+{
+  kBool,
+  kChar,
+  kSigned,
+  kUnsigned,
+  kDouble,
+  kText
+};
+
+/// A thread local stream used to format arguments which an @c ArgWriter cannot defer.
+struct FormatStream
+{
+  std::ostringstream out;
+  /// Set while formatting to detect reentrant use from a streaming operator which also logs.
+  bool busy = false;
+
+  inline FormatStream() { prepareStream(out); }
+};
+
+/// Access the @c FormatStream for the current thread.
+/// @return The thread's format stream.
+inline FormatStream &formatStream()
+{
+  thread_local FormatStream stream;
+  return stream;
+}
+
+/// Convert @p value to text using the @c formatStream() .
+/// @param value The value to format.
+/// @return The formatted text.
+template <typename T>
+inline std::string formatValue(const T &value)
+{
+  FormatStream &stream = formatStream();
+  if (stream.busy)
+  {
+    std::ostringstream out;
+    prepareStream(out);
+    out << value;
+    return out.str();
+  }
+  stream.busy = true;
+  stream.out.str(std::string());
+  stream.out.clear();
+  stream.out << value;
+  std::string text = stream.out.str();
+  stream.busy = false;
+  return text;
+}
+
+/// Encodes log message arguments into a fixed size buffer so that formatting may be deferred to another thread. See
+/// @c LogAsync .
+///
+/// Arithmetic values are copied as tagged binary values and strings are copied as text. Other types cannot safely be
+/// formatted later, so are converted to text immediately using the @c formatStream() . Arguments which do not fit are
+/// dropped and the message is marked as @c truncated() .
+class ArgWriter
+{
+public:
+  /// Constructor.
+  /// @param buffer The buffer to write to.
+  /// @param capacity The byte size of @p buffer .
+  inline ArgWriter(uint8_t *buffer, size_t capacity)
+    : begin_(buffer)
+    , cursor_(buffer)
+    , end_(buffer + capacity)
+  {}
+
+  /// Query the number of bytes written.
+  /// @return The encoded byte count.
+  inline size_t size() const { return size_t(cursor_ - begin_); }
+  /// Query if any arguments were dropped or shortened for lack of space.
+  /// @return True if truncated.
+  inline bool truncated() const { return truncated_; }
+
+  inline void add(bool value) { addRaw(ArgTag::kBool, uint8_t(value)); }
+  inline void add(char value) { addRaw(ArgTag::kChar, value); }
+  inline void add(signed char value) { addRaw(ArgTag::kChar, char(value)); }
+  inline void add(unsigned char value) { addRaw(ArgTag::kChar, char(value)); }
+  inline void add(const char *text)
+  {
+    // Streaming a null string is an error. Log something instead.
+    text = (text) ? text : "(null)";
+    addText(text, std::strlen(text));
+  }
+  inline void add(char *text) { add(static_cast<const char *>(text)); }
+  inline void add(const std::string &text) { addText(text.data(), text.size()); }
+
+  template <typename T>
+  inline void add(const T &value)
+  {
+    addValue(value, std::is_arithmetic<T>());
+  }
+
+  /// Add text, shortening it to fit if required.
+  /// @param text The text to add. Need not be null terminated.
+  /// @param length The number of characters in @p text .
+  inline void addText(const char *text, size_t length)
+  {
+    const size_t header_size = 1u + sizeof(uint16_t);
+    if (truncated_ || size_t(end_ - cursor_) < header_size)
+    {
+      truncated_ = true;
+      return;
+    }
+
+    const size_t available = std::min<size_t>(size_t(end_ - cursor_) - header_size, 0xffffu);
+    if (length > available)
+    {
+      length = available;
+      truncated_ = true;
+    }
+
+    const auto encoded_length = uint16_t(length);
+    *cursor_++ = uint8_t(ArgTag::kText);
+    std::memcpy(cursor_, &encoded_length, sizeof(encoded_length));
+    cursor_ += sizeof(encoded_length);
+    std::memcpy(cursor_, text, length);
+    cursor_ += length;
+  }
+
+private:
+  template <typename T>
+  inline void addValue(const T &value, std::true_type /* arithmetic */)
+  {
+    addArithmetic(value, std::is_floating_point<T>());
+  }
+
+  template <typename T>
+  inline void addValue(const T &value, std::false_type /* arithmetic */)
+  {
+    const std::string text = formatValue(value);
+    addText(text.data(), text.size());
+  }
+
+  template <typename T>
+  inline void addArithmetic(T value, std::true_type /* floating point */)
+  {
+    addRaw(ArgTag::kDouble, double(value));
+  }
+
+  template <typename T>
+  inline void addArithmetic(T value, std::false_type /* floating point */)
+  {
+    addInteger(value, std::is_signed<T>());
+  }
+
+  template <typename T>
+  inline void addInteger(T value, std::true_type /* signed */)
+  {
+    addRaw(ArgTag::kSigned, int64_t(value));
+  }
+
+  template <typename T>
+  inline void addInteger(T value, std::false_type /* signed */)
+  {
+    addRaw(ArgTag::kUnsigned, uint64_t(value));
+  }
+
+  template <typename T>
+  inline void addRaw(ArgTag tag, const T &value)
+  {
+    if (truncated_ || size_t(end_ - cursor_) < 1u + sizeof(T))
+    {
+      truncated_ = true;
+      return;
+    }
+    *cursor_++ = uint8_t(tag);
+    std::memcpy(cursor_, &value, sizeof(T));
+    cursor_ += sizeof(T);
+  }
+
+  uint8_t *begin_;
+  uint8_t *cursor_;
+  uint8_t *end_;
+  bool truncated_ = false;
+};
+
+inline void addArgs(ArgWriter & /*writer*/) {}
+
+template <typename T, typename... Args>
+inline void addArgs(ArgWriter &writer, const T &value, const Args &... args)
+{
+  writer.add(value);
+  addArgs(writer, args...);
+}
 }  // namespace logger_detail
 }  // namespace logutil
 
@@ -8,8 +8,191 @@
 #include "KeyList.h"
 #include "LineWalk.h"
 
+#include <array>
+#include <cstdlib>
+#include <limits>
+
 namespace ohm
 {
+namespace
+{
+/// Structure of arrays state for the rays walked by @c walkBatch() . Per axis arrays are indexed `[axis][lane]` .
+///
+/// Voxels are tracked by global voxel index along each axis: `region_key * region_voxel_dimensions + local_key` .
+/// This reduces stepping to integer addition.
+struct BatchLanes
+{
+  double time_next[3][kSegmentKeysBatchWidth];      ///< @c WalkSteps::time_next
+  double initial_delta[3][kSegmentKeysBatchWidth];  ///< @c WalkSteps::initial_delta
+  double step_delta[3][kSegmentKeysBatchWidth];     ///< @c WalkSteps::step_delta
+  int current[3][kSegmentKeysBatchWidth];           ///< Global index of the current voxel.
+  int end[3][kSegmentKeysBatchWidth];               ///< Global index of the end voxel.
+  int remaining[3][kSegmentKeysBatchWidth];         ///< Voxel steps remaining along each axis.
+  int stepped[3][kSegmentKeysBatchWidth];           ///< Voxel steps taken along each axis.
+  int step_dir[3][kSegmentKeysBatchWidth];          ///< Step direction along each axis: [-1, 1].
+  unsigned axis[kSegmentKeysBatchWidth];            ///< Next axis to step.
+  unsigned limit_flags[kSegmentKeysBatchWidth];     ///< Bit set for each axis with no steps remaining.
+  int stepping[kSegmentKeysBatchWidth];             ///< Step this lane in the current iteration?
+  size_t ray[kSegmentKeysBatchWidth];               ///< Index of the ray walked by each lane.
+  bool active[kSegmentKeysBatchWidth];              ///< Is the lane walking a ray?
+};
+
+inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((-value - 1) / divisor) - 1;
+}
+
+inline Key voxelIndexKey(const int index[3][kSegmentKeysBatchWidth], unsigned lane, const glm::ivec3 &dim)
+{
+  glm::i16vec3 region_key;
+  glm::u8vec3 local_key;
+  for (int i = 0; i < 3; ++i)
+  {
+    const int region = floorDiv(index[i][lane], dim[i]);
+    region_key[i] = int16_t(region);
+    local_key[i] = uint8_t(index[i][lane] - region * dim[i]);
+  }
+  return Key(region_key, local_key);
+}
+
+/// Walk @p ray_count rays in batches of @c kSegmentKeysBatchWidth matching @c detail::walkLineVoxels() .
+///
+/// @param emit Called as `emit(lane, ray, key)` for each key in order along each ray.
+/// @param finish Called as `finish(lane, ray)` once all keys for @c ray have been emitted. Rays with a null start or
+///   end key are finished with no keys.
+/// @return The number of keys emitted.
+template <typename Emit, typename Finish>
+size_t walkBatch(const OccupancyMap &map, const glm::dvec3 *rays, size_t ray_count, bool include_end_point,
+                 Emit &&emit, Finish &&finish)
+{
+  const double length_epsilon = 1e-6;  // NOLINT(readability-magic-numbers)
+  const double infinity = std::numeric_limits<double>::infinity();
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  const glm::dvec3 voxel_resolution(map.resolution());
+
+  BatchLanes lanes{};
+  size_t next_ray = 0;
+  size_t key_count = 0;
+
+  // Start walking the next valid ray in a lane, or deactivate the lane when there are no rays left.
+  const auto load_lane = [&](unsigned lane) {
+    while (next_ray < ray_count)
+    {
+      const size_t ray = next_ray++;
+      const glm::dvec3 &start_point = rays[ray * 2 + 0];
+      const glm::dvec3 &end_point = rays[ray * 2 + 1];
+      const Key start_key = map.voxelKey(start_point);
+      const Key end_key = map.voxelKey(end_point);
+
+      if (start_key.isNull() || end_key.isNull())
+      {
+        finish(lane, ray);
+        continue;
+      }
+
+      detail::WalkSteps steps;
+      detail::walkCalculateSteps(&steps, start_point, end_point, map.voxelCentreGlobal(start_key), voxel_resolution,
+                                 length_epsilon);
+      const glm::ivec3 diff = OccupancyMap::rangeBetween(start_key, end_key, dim);
+
+      lanes.limit_flags[lane] = 0;
+      for (int a = 0; a < 3; ++a)
+      {
+        lanes.current[a][lane] = int(start_key.regionKey()[a]) * dim[a] + int(start_key.localKey()[a]);
+        lanes.end[a][lane] = lanes.current[a][lane] + diff[a];
+        lanes.remaining[a][lane] = diff[a];
+        lanes.stepped[a][lane] = 0;
+        lanes.step_dir[a][lane] = detail::walkStepDir(steps.sign[a]);
+        lanes.initial_delta[a][lane] = steps.initial_delta[a];
+        lanes.step_delta[a][lane] = steps.step_delta[a];
+        lanes.time_next[a][lane] = (diff[a]) ? steps.initial_delta[a] : infinity;
+        lanes.limit_flags[lane] |= !!(diff[a] == 0) * (1u << unsigned(a));
+      }
+
+      unsigned axis = (lanes.time_next[0][lane] < lanes.time_next[1][lane]) ? 0u : 1u;
+      axis = (lanes.time_next[axis][lane] < lanes.time_next[2][lane]) ? axis : 2u;
+      lanes.axis[lane] = axis;
+      lanes.ray[lane] = ray;
+      lanes.active[lane] = true;
+      return;
+    }
+
+    lanes.active[lane] = false;
+  };
+
+  bool any_active = false;
+  for (unsigned lane = 0; lane < kSegmentKeysBatchWidth; ++lane)
+  {
+    load_lane(lane);
+    any_active = any_active || lanes.active[lane];
+  }
+
+  while (any_active)
+  {
+    // Emit the current voxel for each lane. Lanes reaching the end voxel complete their ray and load the next one.
+    for (unsigned lane = 0; lane < kSegmentKeysBatchWidth; ++lane)
+    {
+      lanes.stepping[lane] = 0;
+      while (lanes.active[lane])
+      {
+        if (lanes.limit_flags[lane] < 7u &&
+            (lanes.current[0][lane] != lanes.end[0][lane] || lanes.current[1][lane] != lanes.end[1][lane] ||
+             lanes.current[2][lane] != lanes.end[2][lane]))
+        {
+          emit(lane, lanes.ray[lane], voxelIndexKey(lanes.current, lane, dim));
+          ++key_count;
+          lanes.stepping[lane] = 1;
+          break;
+        }
+
+        if (include_end_point)
+        {
+          emit(lane, lanes.ray[lane], voxelIndexKey(lanes.end, lane, dim));
+          ++key_count;
+        }
+        finish(lane, lanes.ray[lane]);
+        load_lane(lane);
+      }
+    }
+
+    // Step all stepping lanes along their selected axis. Written without branches on the lane state.
+    for (unsigned a = 0; a < 3; ++a)
+    {
+      for (unsigned lane = 0; lane < kSegmentKeysBatchWidth; ++lane)
+      {
+        const int sel = lanes.stepping[lane] & int(lanes.axis[lane] == a);
+        const int dir = sel * lanes.step_dir[a][lane];
+        lanes.current[a][lane] += dir;
+        lanes.remaining[a][lane] -= dir;
+        lanes.stepped[a][lane] += dir;
+        const int done = int(lanes.remaining[a][lane] == 0);
+        const double next = (done) ? infinity :
+                                     lanes.initial_delta[a][lane] +
+                                       lanes.step_delta[a][lane] * std::abs(lanes.stepped[a][lane]);
+        lanes.time_next[a][lane] = (sel) ? next : lanes.time_next[a][lane];
+        lanes.limit_flags[lane] |= unsigned(sel & done) << a;
+      }
+    }
+
+    any_active = false;
+    for (unsigned lane = 0; lane < kSegmentKeysBatchWidth; ++lane)
+    {
+      const double time_x = lanes.time_next[0][lane];
+      const double time_y = lanes.time_next[1][lane];
+      const double time_z = lanes.time_next[2][lane];
+      unsigned axis = (time_x < time_y) ? 0u : 1u;
+      const double time_axis = (time_x < time_y) ? time_x : time_y;
+      axis = (time_axis < time_z) ? axis : 2u;
+      lanes.axis[lane] = axis;
+      any_active = any_active || lanes.active[lane];
+    }
+  }
+
+  return key_count;
+}
+}  // namespace
+
+
 size_t calculateSegmentKeys(KeyList &keys, const OccupancyMap &map, const glm::dvec3 &start_point,
                             const glm::dvec3 &end_point, bool include_end_point)
 {
@@ -24,4 +207,57 @@ size_t calculateSegmentKeys(KeyList &keys, const OccupancyMap &map, const glm::d
                                          }),
                          start_point, end_point, (include_end_point) ? 0u : kExcludeEndVoxel);
 }
+
+
+size_t calculateSegmentKeysBatch(KeyList *keys, const OccupancyMap &map, const glm::dvec3 *rays,
+                                 size_t element_count, bool include_end_point)
+{
+  const size_t ray_count = element_count / 2;
+  if (ray_count < 2)
+  {
+    // Nothing to batch.
+    return (ray_count) ? calculateSegmentKeys(keys[0], map, rays[0], rays[1], include_end_point) : 0u;
+  }
+
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    keys[i].clear();
+  }
+
+  return walkBatch(
+    map, rays, ray_count, include_end_point,
+    [keys](unsigned lane, size_t ray, const Key &key) {
+      (void)lane;  // Unused
+      keys[ray].add(key);
+    },
+    [](unsigned lane, size_t ray) {
+      (void)lane;  // Unused
+      (void)ray;   // Unused
+    });
+}
+
+
+size_t calculateSegmentKeysBatch(SegmentKeys &keys, const OccupancyMap &map, const glm::dvec3 *rays,
+                                 size_t element_count, bool include_end_point)
+{
+  const size_t ray_count = element_count / 2;
+  keys.clear();
+  keys.ray_offsets.resize(ray_count);
+  keys.ray_counts.resize(ray_count);
+
+  // Stage keys per lane so each ray's keys are contiguous.
+  std::array<std::vector<Key>, kSegmentKeysBatchWidth> staged;
+  return walkBatch(
+    map, rays, ray_count, include_end_point,
+    [&staged](unsigned lane, size_t ray, const Key &key) {
+      (void)ray;  // Unused
+      staged[lane].emplace_back(key);
+    },
+    [&keys, &staged](unsigned lane, size_t ray) {
+      keys.ray_offsets[ray] = keys.keys.size();
+      keys.ray_counts[ray] = unsigned(staged[lane].size());
+      keys.keys.insert(keys.keys.end(), staged[lane].begin(), staged[lane].end());
+      staged[lane].clear();
+    });
+}
 }  // namespace ohm
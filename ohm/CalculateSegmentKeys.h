@@ -8,7 +8,10 @@
 
 #include "OhmConfig.h"
 
+#include "Key.h"
+
 #include <cstddef>
+#include <vector>
 
 #include <glm/fwd.hpp>
 
@@ -17,6 +20,28 @@ namespace ohm
 class KeyList;
 class OccupancyMap;
 
+/// Number of rays walked in lock step by @c calculateSegmentKeysBatch() .
+constexpr unsigned kSegmentKeysBatchWidth = 8u;
+
+/// Flat output buffer for @c calculateSegmentKeysBatch() .
+///
+/// The keys for each ray are contiguous in @c keys , starting at @c ray_offsets[i] with @c ray_counts[i] items for ray
+/// @c i . Rays are not necessarily stored in ray order.
+struct ohm_API SegmentKeys
+{
+  std::vector<Key> keys;              ///< Keys for all rays.
+  std::vector<size_t> ray_offsets;    ///< Index of the first key of each ray in @c keys .
+  std::vector<unsigned> ray_counts;   ///< Number of keys for each ray.
+
+  /// Clear the buffer, retaining memory.
+  inline void clear()
+  {
+    keys.clear();
+    ray_offsets.clear();
+    ray_counts.clear();
+  }
+};
+
 /// This populates a @c KeyList with the voxel @c Key values intersected by a line segment.
 ///
 /// This utility function leverages @c walkSegmentKeys() in order to calculate the set of voxel @c Key values
@@ -30,6 +55,29 @@ class OccupancyMap;
 ///     even when the @p start_point is in the same voxel (this case would generate an empty list).
 size_t ohm_API calculateSegmentKeys(KeyList &keys, const OccupancyMap &map, const glm::dvec3 &start_point,
                                     const glm::dvec3 &end_point, bool include_end_point = true);
+
+/// Populate a @c KeyList for each line segment in @p rays , walking @c kSegmentKeysBatchWidth rays at a time.
+///
+/// This yields the same keys as calling @c calculateSegmentKeys() for each ray, but steps multiple rays in lock step
+/// using a structure of arrays layout. Voxels are stepped in a global voxel index space, deferring conversion to
+/// @c Key until each key is emitted, and the per step state updates are written to allow compiler vectorisation.
+/// A finished ray is replaced by the next ray straight away to keep the batch full. Fewer than two rays use the
+/// @c calculateSegmentKeys() path.
+///
+/// @param[out] keys Array of @c KeyList objects with one item per ray; @p element_count/2 items. Each list is cleared
+///   then populated with the keys for the corresponding ray.
+/// @param map The occupancy map to calculate key segments for.
+/// @param rays Array of start/end point pairs. Global map frame.
+/// @param element_count The number of points in @p rays . The ray count is half this value.
+/// @param include_end_point True to include the voxel containing each end point.
+/// @return The total number of keys added.
+size_t ohm_API calculateSegmentKeysBatch(KeyList *keys, const OccupancyMap &map, const glm::dvec3 *rays,
+                                         size_t element_count, bool include_end_point = true);
+
+/// @overload
+/// Populates a flat @c SegmentKeys buffer instead of per ray @c KeyList objects. The buffer is cleared first.
+size_t ohm_API calculateSegmentKeysBatch(SegmentKeys &keys, const OccupancyMap &map, const glm::dvec3 *rays,
+                                         size_t element_count, bool include_end_point = true);
 }  // namespace ohm
 
 #endif  // CALCULATESEGMENTKEYS_H
@@ -0,0 +1,63 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ClearingBatch.h"
+
+#include "RayPattern.h"
+
+namespace ohm
+{
+void ClearingBatch::add(const ClearingPattern &pattern, const glm::dvec3 &position, const glm::dquat &rotation,
+                        float probability_scaling)
+{
+  pattern.pattern()->buildRays(&ray_set_, position, rotation);
+  std::vector<glm::dvec3> &rays = groupRays(pattern.rayFlags(), probability_scaling);
+  rays.insert(rays.end(), ray_set_.begin(), ray_set_.end());
+}
+
+
+void ClearingBatch::add(const ClearingPattern &pattern, const glm::dmat4 &pattern_transform,
+                        float probability_scaling)
+{
+  pattern.pattern()->buildRays(&ray_set_, pattern_transform);
+  std::vector<glm::dvec3> &rays = groupRays(pattern.rayFlags(), probability_scaling);
+  rays.insert(rays.end(), ray_set_.begin(), ray_set_.end());
+}
+
+
+size_t ClearingBatch::rayCount() const
+{
+  size_t ray_count = 0;
+  for (const Group &group : groups_)
+  {
+    ray_count += group.rays.size() / 2;
+  }
+  return ray_count;
+}
+
+
+void ClearingBatch::clear()
+{
+  groups_.clear();
+}
+
+
+std::vector<glm::dvec3> &ClearingBatch::groupRays(unsigned ray_flags, float probability_scaling)
+{
+  // Expect very few groups, so a linear search suffices.
+  for (Group &group : groups_)
+  {
+    if (group.ray_flags == ray_flags && group.probability_scaling == probability_scaling)
+    {
+      return group.rays;
+    }
+  }
+
+  groups_.emplace_back();
+  groups_.back().ray_flags = ray_flags;
+  groups_.back().probability_scaling = probability_scaling;
+  return groups_.back().rays;
+}
+}  // namespace ohm
@@ -0,0 +1,117 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_CLEARINGBATCH_H
+#define OHM_CLEARINGBATCH_H
+
+#include "OhmConfig.h"
+
+#include "ClearingPattern.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace ohm
+{
+/// Accumulates the rays of multiple @c ClearingPattern applications to integrate them with as few map updates as
+/// possible.
+///
+/// Each @c ClearingPattern::apply() call makes a separate @c integrateRays() call, which, for a @c GpuMap , is a
+/// separate GPU batch with its own upload and kernel launch overheads. A @c ClearingBatch instead collects the
+/// transformed rays of several patterns and poses via @c add() . @c apply() then integrates all rays which share the
+/// same @c ClearingPattern::rayFlags() and probability scaling as a single @c integrateRays() call. Typically all
+/// clearing patterns for an update cycle share a group, requiring a single GPU batch.
+///
+/// @code
+/// ohm::ClearingBatch batch;
+/// for (const Pose &pose : sensor_poses)
+/// {
+///   batch.add(clearing_pattern, pose.position, pose.rotation);
+/// }
+/// batch.apply(&gpu_map);
+/// @endcode
+class ohm_API ClearingBatch
+{
+public:
+  /// Add the rays of @p pattern , transformed by @p position and @p rotation . See @c ClearingPattern::apply() .
+  /// @param pattern The clearing pattern to add.
+  /// @param position Used as the origin of the rays in the @p pattern .
+  /// @param rotation Rotates the ray end points in the @p pattern .
+  /// @param probability_scaling Scaling factor applied to the miss value for these rays.
+  void add(const ClearingPattern &pattern, const glm::dvec3 &position, const glm::dquat &rotation,
+           float probability_scaling = 1.0f);
+
+  /// @overload
+  void add(const ClearingPattern &pattern, const glm::dmat4 &pattern_transform, float probability_scaling = 1.0f);
+
+  /// Query the number of rays pending.
+  /// @return The number of pending rays.
+  size_t rayCount() const;
+
+  /// Query the number of @c integrateRays() calls @c apply() will make. There is one for each distinct combination
+  /// of @c ClearingPattern::rayFlags() and probability scaling.
+  /// @return The number of ray groups.
+  inline size_t groupCount() const { return groups_.size(); }
+
+  /// Query if there are no pending rays.
+  /// @return True when empty.
+  inline bool empty() const { return groups_.empty(); }
+
+  /// Discard all pending rays.
+  void clear();
+
+  /// Integrate all pending rays into @p map then @c clear() . This supports both @c OccupancyMap and @c GpuMap .
+  ///
+  /// The map miss value is modified for each group which does not have unit probability scaling, so the @p map must
+  /// not be updated concurrently. Rays pending in a @c GpuMap stream batch are submitted first.
+  ///
+  /// @param map The map to integrate the clearing rays into.
+  /// @return The number of rays submitted to the @p map .
+  template <typename MAP>
+  size_t apply(MAP *map);
+
+private:
+  /// Rays sharing the same update settings.
+  struct Group
+  {
+    std::vector<glm::dvec3> rays;
+    unsigned ray_flags = 0;
+    float probability_scaling = 1.0f;
+  };
+
+  std::vector<glm::dvec3> &groupRays(unsigned ray_flags, float probability_scaling);
+
+  std::vector<Group> groups_;
+  std::vector<glm::dvec3> ray_set_;
+};
+
+
+template <typename MAP>
+size_t ClearingBatch::apply(MAP *map)
+{
+  const float initial_miss_value = map->missValue();
+  size_t ray_count = 0;
+  detail::flushPendingRays(map, 0);
+  for (const Group &group : groups_)
+  {
+    if (group.probability_scaling != 1.0f)
+    {
+      map->setMissValue(initial_miss_value * group.probability_scaling);
+    }
+    map->integrateRays(group.rays.data(), unsigned(group.rays.size()), nullptr, nullptr, group.ray_flags);
+    ray_count += group.rays.size() / 2;
+    if (group.probability_scaling != 1.0f)
+    {
+      detail::flushPendingRays(map, 0);
+      map->setMissValue(initial_miss_value);
+    }
+  }
+  clear();
+  return ray_count;
+}
+}  // namespace ohm
+
+#endif  // OHM_CLEARINGBATCH_H
@@ -6,11 +6,97 @@
 #include "ClearingPattern.h"
 #include "private/ClearingPatternDetail.h"
 
+#include "CalculateSegmentKeys.h"
+#include "DefaultLayer.h"
+#include "KeyList.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
 #include "OccupancyMap.h"
+#include "OccupancyState.h"
 #include "RayPattern.h"
+#include "Voxel.h"
+#include "VoxelOccupancy.h"
+
+#include <limits>
 
 namespace ohm
 {
+namespace
+{
+/// Map parameters for updating voxels in @c ClearingPattern::applyKeyTemplate() .
+struct KeyTemplateParams
+{
+  float miss_value = 0;
+  float hit_value = 0;
+  float occupancy_threshold_value = 0;
+  float voxel_min = 0;
+  float voxel_max = 0;
+  float saturation_min = 0;
+  float saturation_max = 0;
+  unsigned ray_flags = 0;
+};
+
+
+/// Apply a miss or hit update to the voxel at @p key for @c ClearingPattern::applyKeyTemplate() . The @p state voxel
+/// is also updated when it references a valid occupancy state layer which is not stale for the region.
+/// @return True if the voxel was occupied before the update.
+bool updateTemplateVoxel(OccupancyMap &map, Voxel<float> &occupancy, Voxel<uint16_t> &state,
+                         const KeyTemplateParams &params, const Key &key, bool hit)
+{
+  // Voxels in missing regions are unobserved. Skip them without creating the region if they are to be excluded.
+  if ((params.ray_flags & kRfExcludeUnobserved) && !map.region(key.regionKey()))
+  {
+    return false;
+  }
+
+  occupancy.setKey(key);
+  float occupancy_value;
+  occupancy.read(&occupancy_value);
+  const float initial_value = occupancy_value;
+
+  const bool initially_unobserved = initial_value == unobservedOccupancyValue();
+  const bool initially_free = !initially_unobserved && initial_value < params.occupancy_threshold_value;
+  const bool initially_occupied = !initially_unobserved && initial_value >= params.occupancy_threshold_value;
+
+  if ((initially_unobserved && (params.ray_flags & kRfExcludeUnobserved)) ||
+      (initially_free && (params.ray_flags & kRfExcludeFree)) ||
+      (initially_occupied && (params.ray_flags & kRfExcludeOccupied)))
+  {
+    return initially_occupied;
+  }
+
+  if (hit)
+  {
+    occupancyAdjustHit(&occupancy_value, initial_value, params.hit_value, unobservedOccupancyValue(),
+                       params.voxel_max, params.saturation_min, params.saturation_max, false);
+  }
+  else
+  {
+    occupancyAdjustMiss(&occupancy_value, initial_value, params.miss_value, unobservedOccupancyValue(),
+                        params.voxel_min, params.saturation_min, params.saturation_max, false);
+  }
+  occupancy.write(occupancy_value);
+
+  if (state.isLayerValid())
+  {
+    state.setKey(Key(key.regionKey(), key.localKey() / uint8_t(2)));
+    // Leave a stale state layer untouched so that it remains stale - see occupancyStateStale().
+    if (occupancyStateStale(*state.chunk(), occupancy.layerIndex(), state.layerIndex()))
+    {
+      return initially_occupied;
+    }
+    uint16_t packed = 0;
+    state.read(&packed);
+    packed = packOccupancyState(packed, key.localKey(),
+                                occupancyStateFromValue(occupancy_value, params.occupancy_threshold_value));
+    state.write(packed);
+  }
+
+  return initially_occupied;
+}
+}  // namespace
+
+
 ClearingPattern::ClearingPattern(const RayPattern *pattern, bool take_ownership)
   : imp_(new ClearingPatternDetail)
 {
@@ -48,6 +134,83 @@ void ClearingPattern::setRayFlags(unsigned ray_flags)
   imp_->ray_flags = ray_flags;
 }
 
+void ClearingPattern::applyKeyTemplate(OccupancyMap *map, const glm::dvec3 &position, const glm::dquat &rotation,
+                                       float probability_scaling)
+{
+  buildKeyTemplate(*map, rotation);
+
+  KeyTemplateParams params;
+  params.miss_value = map->missValue() * probability_scaling;
+  params.hit_value = map->hitValue() * probability_scaling;
+  params.occupancy_threshold_value = map->occupancyThresholdValue();
+  params.voxel_min = map->minVoxelValue();
+  params.voxel_max = map->maxVoxelValue();
+  params.saturation_min = map->saturateAtMinValue() ? params.voxel_min : std::numeric_limits<float>::lowest();
+  params.saturation_max = map->saturateAtMaxValue() ? params.voxel_max : std::numeric_limits<float>::max();
+  params.ray_flags = rayFlags();
+
+  Voxel<float> occupancy(map, map->layout().occupancyLayer());
+  if (!occupancy.isLayerValid())
+  {
+    return;
+  }
+
+  // The state layer is derived data. Skip it if it does not have the expected layout.
+  int state_layer = map->layout().layerIndex(default_layer::occupancyStateLayerName());
+  if (state_layer >= 0 &&
+      map->layout().layer(state_layer).dimensions(map->regionVoxelDimensions()) * uint8_t(2) != occupancy.layerDim())
+  {
+    state_layer = -1;
+  }
+  Voxel<uint16_t> state(map, state_layer);
+
+  const unsigned ray_flags = params.ray_flags;
+  // The end voxel is the sample voxel unless it is to be treated as free.
+  const bool end_is_sample = !(ray_flags & kRfEndPointAsFree);
+  const Key origin_key = map->voxelKey(position);
+  size_t ray_start = 0;
+  for (const size_t ray_end : imp_->key_template_ray_ends)
+  {
+    if (ray_end == ray_start)
+    {
+      continue;
+    }
+
+    // Only skip the origin voxel if it is not also the end voxel.
+    size_t miss_index = ray_start + (((ray_flags & kRfExcludeOrigin) && ray_end - ray_start > 1) ? 1u : 0u);
+    const size_t miss_end = (end_is_sample) ? ray_end - 1 : ray_end;
+    bool stop_adjustments = false;
+    for (; !(ray_flags & kRfExcludeRay) && !stop_adjustments && miss_index < miss_end; ++miss_index)
+    {
+      Key key = origin_key;
+      map->moveKey(key, imp_->key_template[miss_index]);
+      const bool initially_occupied = updateTemplateVoxel(*map, occupancy, state, params, key, false);
+      stop_adjustments = (ray_flags & kRfStopOnFirstOccupied) && initially_occupied;
+    }
+
+    if (end_is_sample && !stop_adjustments && !(ray_flags & kRfExcludeSample))
+    {
+      Key key = origin_key;
+      map->moveKey(key, imp_->key_template[ray_end - 1]);
+      updateTemplateVoxel(*map, occupancy, state, params, key, true);
+    }
+
+    ray_start = ray_end;
+  }
+
+  // Stamp the occupancy layer before the state layer so the last region is not left stale.
+  occupancy.commit();
+  state.commit();
+}
+
+
+const glm::ivec3 *ClearingPattern::keyTemplate(size_t *element_count) const
+{
+  *element_count = imp_->key_template.size();
+  return imp_->key_template.data();
+}
+
+
 const glm::dvec3 *ClearingPattern::lastRaySet(size_t *element_count) const
 {
   *element_count = imp_->ray_set.size();
@@ -70,4 +233,40 @@ const glm::dvec3 *ClearingPattern::buildRaySet(size_t *element_count, const glm:
   *element_count = imp_->ray_set.size();
   return imp_->ray_set.data();
 }
+
+
+void ClearingPattern::buildKeyTemplate(const OccupancyMap &map, const glm::dquat &rotation)
+{
+  const size_t ray_count = imp_->pattern->rayCount();
+  if (imp_->key_template_valid && imp_->key_template_rotation == rotation &&
+      imp_->key_template_resolution == map.resolution() && imp_->key_template_ray_ends.size() == ray_count)
+  {
+    return;
+  }
+
+  imp_->key_template.clear();
+  imp_->key_template_ray_ends.clear();
+  imp_->key_template_ray_ends.reserve(ray_count);
+
+  // Walk the rays from the centre of a reference voxel and store the keys as offsets from that voxel.
+  const Key reference_key = map.voxelKey(map.origin());
+  const glm::dvec3 reference_centre = map.voxelCentreGlobal(reference_key);
+  const glm::dvec3 *ray_points = imp_->pattern->rayPoints();
+  KeyList keys;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    const glm::dvec3 start = rotation * ray_points[i * 2 + 0] + reference_centre;
+    const glm::dvec3 end = rotation * ray_points[i * 2 + 1] + reference_centre;
+    calculateSegmentKeys(keys, map, start, end, true);
+    for (const Key &key : keys)
+    {
+      imp_->key_template.emplace_back(map.rangeBetween(reference_key, key));
+    }
+    imp_->key_template_ray_ends.emplace_back(imp_->key_template.size());
+  }
+
+  imp_->key_template_rotation = rotation;
+  imp_->key_template_resolution = map.resolution();
+  imp_->key_template_valid = true;
+}
 }  // namespace ohm
@@ -21,6 +21,23 @@ namespace ohm
 struct ClearingPatternDetail;
 class OccupancyMap;
 
+namespace detail
+{
+/// Submit any rays pending in a stream batch of @p map - see @c GpuMap::flushStream() . This ensures rays are
+/// integrated using the miss value in effect when they were given to the map.
+/// @param map The map to flush.
+template <typename MAP>
+inline auto flushPendingRays(MAP *map, int) -> decltype(map->flushStream(), void())
+{
+  map->flushStream();
+}
+
+/// Overload for map types which do not support stream batching: does nothing.
+template <typename MAP>
+inline void flushPendingRays(MAP * /*map*/, long)
+{}
+}  // namespace detail
+
 /// A helper class for applying a @c RayPattern as a clearing pattern to an @c OccupancyMap. The @p apply() method is
 /// templated so that it may also be used to apply a clearing pattern to a @c GpuMap.
 ///
@@ -85,6 +102,10 @@ public:
   /// @param position Used to the origin of the rays in this clearing pattern.
   /// @param rotation Rotates the ray end points in this clearing pattern.
   /// @param probability_scaling Scaling factor applied to probability values.
+  ///
+  /// @note The map miss value is modified for the duration of the call, so the @p map must not be updated
+  /// concurrently. Rays pending in a @c GpuMap stream batch are submitted before and after the update. Use a
+  /// @c ClearingBatch to combine multiple patterns and poses into a single update.
   template <typename MAP>
   void apply(MAP *map, const glm::dvec3 &position, const glm::dquat &rotation, float probability_scaling = 1.0);
 
@@ -92,6 +113,33 @@ public:
   template <typename MAP>
   void apply(MAP *map, const glm::dmat4 &pattern_transform, float probability_scaling = 1.0);
 
+  /// Apply the clearing @c pattern() to @p map using a cached voxel key template instead of walking the pattern rays.
+  ///
+  /// The key template holds the voxel offsets traversed by each pattern ray relative to the voxel containing the ray
+  /// origin. It is translation invariant, so it is built on first use and reused for every call with the same
+  /// @p rotation and map resolution, only being rebuilt when either changes. This suits constant patterns such as
+  /// @c RayPatternConical applied from a sensor with a fixed orientation.
+  ///
+  /// The template quantises @p position to its voxel centre, so the voxels updated may differ slightly from
+  /// @c apply() for rays passing close to voxel boundaries. Unlike @c apply() , the miss and hit values are scaled by
+  /// @p probability_scaling without modifying the @p map settings. The @c rayFlags() are honoured for the ray start,
+  /// ray, end point and @c kRfExclude<Type> behaviour as well as @c kRfStopOnFirstOccupied .
+  ///
+  /// This supports the CPU @c OccupancyMap only. Use @c apply() for a @c GpuMap .
+  ///
+  /// @param map The map to integrate the clearing pattern into.
+  /// @param position The origin of the rays in this clearing pattern.
+  /// @param rotation Rotates the ray end points in this clearing pattern.
+  /// @param probability_scaling Scaling factor applied to the miss and hit values.
+  void applyKeyTemplate(OccupancyMap *map, const glm::dvec3 &position, const glm::dquat &rotation,
+                        float probability_scaling = 1.0f);
+
+  /// Query the key template last used in @c applyKeyTemplate() . These are voxel offsets from the ray origin voxel
+  /// for all rays in the pattern, concatenated.
+  /// @param[out] element_count Set to the number of elements in the returned value.
+  /// @return A pointer to the key template.
+  const glm::ivec3 *keyTemplate(size_t *element_count) const;
+
   /// Query the last ray set used in @c apply . This is the pattern transformed to match the position and rotation
   /// last supplied to @c apply() . Contains start/end pairs.
   /// @param[out] element_count Set to the number of elements in the returned value. The number of rays is half this.
@@ -103,6 +151,8 @@ private:
 
   const glm::dvec3 *buildRaySet(size_t *element_count, const glm::dmat4 &pattern_transform);
 
+  void buildKeyTemplate(const OccupancyMap &map, const glm::dquat &rotation);
+
   std::unique_ptr<ClearingPatternDetail> imp_;
 };
 
@@ -112,8 +162,11 @@ void ClearingPattern::apply(MAP *map, const glm::dvec3 &position, const glm::dqu
   size_t ray_element_count = 0u;
   const glm::dvec3 *ray_set = buildRaySet(&ray_element_count, position, rotation);
   const float initial_miss_value = map->missValue();
+  // Pending stream rays must not see the modified miss value, nor may the clearing rays be left pending.
+  detail::flushPendingRays(map, 0);
   map->setMissValue(initial_miss_value * probability_scaling);
   map->integrateRays(ray_set, unsigned(ray_element_count), nullptr, nullptr, rayFlags());
+  detail::flushPendingRays(map, 0);
   map->setMissValue(initial_miss_value);
 }
 
@@ -124,8 +177,11 @@ void ClearingPattern::apply(MAP *map, const glm::dmat4 &pattern_transform, float
   size_t ray_element_count = 0u;
   const glm::dvec3 *ray_set = buildRaySet(&ray_element_count, pattern_transform);
   const float initial_miss_value = map->missValue();
+  // Pending stream rays must not see the modified miss value, nor may the clearing rays be left pending.
+  detail::flushPendingRays(map, 0);
   map->setMissValue(initial_miss_value * probability_scaling);
   map->integrateRays(ray_set, unsigned(ray_element_count), nullptr, nullptr, rayFlags());
+  detail::flushPendingRays(map, 0);
   map->setMissValue(initial_miss_value);
 }
 }  // namespace ohm
@@ -0,0 +1,666 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "CollisionQuery.h"
+
+#include "private/CollisionQueryDetail.h"
+#include "private/QueryRegionCache.h"
+
+#include "Key.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "TaskArena.h"
+#include "VoxelOccupancy.h"
+
+#include <glm/gtc/matrix_access.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace ohm
+{
+namespace
+{
+/// Number of results per independently evaluated block.
+constexpr size_t kResultsPerBlock = 64u;
+/// Threshold below which direction components are considered parallel to a voxel row.
+constexpr double kParallelEpsilon = 1e-12;
+
+/// A @c CollisionShape resolved at a @c CollisionPose in map coordinates, with padding applied.
+struct PosedShape
+{
+  CollisionShape::Type type = CollisionShape::kBox;
+  glm::dvec3 centre{ 0 };
+  /// Box: transforms from the map frame into the box frame.
+  glm::dmat3 inv_rotation{ 1.0 };
+  /// Box: the padded half extents.
+  glm::dvec3 half_extents{ 0 };
+  /// Capsule: segment start point.
+  glm::dvec3 segment_start{ 0 };
+  /// Capsule: segment end point.
+  glm::dvec3 segment_end{ 0 };
+  /// Capsule: the padded radius.
+  double radius = 0;
+  glm::dvec3 aabb_min{ 0 };
+  glm::dvec3 aabb_max{ 0 };
+};
+
+/// An interval [lower, upper] along a voxel row. Empty when lower > upper.
+struct RowInterval
+{
+  double lower = -std::numeric_limits<double>::infinity();
+  double upper = std::numeric_limits<double>::infinity();
+
+  inline bool empty() const { return lower > upper; }
+  inline void intersect(double a, double b)
+  {
+    lower = std::max(lower, std::min(a, b));
+    upper = std::min(upper, std::max(a, b));
+  }
+  inline void merge(const RowInterval &other)
+  {
+    if (other.empty())
+    {
+      return;
+    }
+    if (empty())
+    {
+      *this = other;
+      return;
+    }
+    lower = std::min(lower, other.lower);
+    upper = std::max(upper, other.upper);
+  }
+  static inline RowInterval none() { return RowInterval{ 1, 0 }; }
+};
+
+/// Context shared by all shape tests in a query.
+struct CollisionContext
+{
+  OccupancyMap *map = nullptr;
+  glm::ivec3 region_dim{ 0 };
+  VoxelOrder occupancy_order = VoxelOrder::kRowMajor;
+  VoxelOrder clearance_order = VoxelOrder::kRowMajor;
+  /// The centre of the global voxel zero.
+  glm::dvec3 voxel_zero_centre{ 0 };
+  double resolution = 0;
+  float occupancy_threshold = 0;
+  double padding = 0;
+  int occupancy_layer = -1;
+  /// Clearance layer index when testing capsules against the clearance layer, otherwise -1.
+  int clearance_layer = -1;
+  bool unknown_as_occupied = false;
+};
+
+/// Per worker state: region caches for each layer used.
+struct CollisionWorker
+{
+  QueryRegionCache occupancy;
+  QueryRegionCache clearance;
+
+  explicit CollisionWorker(const CollisionContext &ctx)
+    : occupancy(*ctx.map, ctx.occupancy_layer)
+    , clearance(*ctx.map, ctx.clearance_layer)
+  {}
+};
+
+
+inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+
+inline glm::ivec3 globalVoxel(const Key &key, const glm::ivec3 &dim)
+{
+  return glm::ivec3(key.regionKey()) * dim + glm::ivec3(key.localKey());
+}
+
+
+/// Calculate the interval of @p x where `a * x^2 + b * x + c <= 0` , with @p a non-negative.
+RowInterval quadraticInterval(double a, double b, double c)
+{
+  if (a < kParallelEpsilon)
+  {
+    // b is zero with a. The whole row is inside or outside.
+    return (c <= 0) ? RowInterval{} : RowInterval::none();
+  }
+
+  const double discriminant = b * b - 4.0 * a * c;
+  if (discriminant < 0)
+  {
+    return RowInterval::none();
+  }
+
+  const double root = std::sqrt(discriminant);
+  return RowInterval{ (-b - root) / (2.0 * a), (-b + root) / (2.0 * a) };
+}
+
+
+/// Calculate the interval of row steps @p x for which `row_start + x * row_step` lies within the sphere at @p centre .
+RowInterval sphereInterval(const glm::dvec3 &row_start, const glm::dvec3 &row_step, const glm::dvec3 &centre,
+                           double radius)
+{
+  const glm::dvec3 w = row_start - centre;
+  return quadraticInterval(glm::dot(row_step, row_step), 2.0 * glm::dot(w, row_step),
+                           glm::dot(w, w) - radius * radius);
+}
+
+
+/// Calculate the interval of row steps which lie inside @p shape .
+RowInterval shapeRowInterval(const PosedShape &shape, const glm::dvec3 &row_start, const glm::dvec3 &row_step)
+{
+  if (shape.type == CollisionShape::kBox)
+  {
+    // Slab test in the box frame.
+    const glm::dvec3 a = shape.inv_rotation * (row_start - shape.centre);
+    const glm::dvec3 b = shape.inv_rotation * row_step;
+    RowInterval interval;
+    for (int i = 0; i < 3; ++i)
+    {
+      if (std::abs(b[i]) < kParallelEpsilon)
+      {
+        if (std::abs(a[i]) > shape.half_extents[i])
+        {
+          return RowInterval::none();
+        }
+        continue;
+      }
+      interval.intersect((-shape.half_extents[i] - a[i]) / b[i], (shape.half_extents[i] - a[i]) / b[i]);
+    }
+    return interval;
+  }
+
+  // Capsule: union of the end cap spheres and the finite cylinder.
+  RowInterval interval = sphereInterval(row_start, row_step, shape.segment_start, shape.radius);
+  interval.merge(sphereInterval(row_start, row_step, shape.segment_end, shape.radius));
+
+  const glm::dvec3 axis = shape.segment_end - shape.segment_start;
+  const double length = glm::length(axis);
+  if (length > 0)
+  {
+    const glm::dvec3 u = axis / length;
+    const glm::dvec3 w = row_start - shape.segment_start;
+    const glm::dvec3 w_perp = w - glm::dot(w, u) * u;
+    const glm::dvec3 step_perp = row_step - glm::dot(row_step, u) * u;
+    RowInterval cylinder = quadraticInterval(glm::dot(step_perp, step_perp), 2.0 * glm::dot(w_perp, step_perp),
+                                             glm::dot(w_perp, w_perp) - shape.radius * shape.radius);
+    // Clip to the slab between the end caps.
+    const double axial = glm::dot(w, u);
+    const double axial_step = glm::dot(row_step, u);
+    if (std::abs(axial_step) < kParallelEpsilon)
+    {
+      if (axial < 0 || axial > length)
+      {
+        cylinder = RowInterval::none();
+      }
+    }
+    else
+    {
+      cylinder.intersect(-axial / axial_step, (length - axial) / axial_step);
+    }
+    interval.merge(cylinder);
+  }
+
+  return interval;
+}
+
+
+PosedShape poseShape(const CollisionShape &shape, const CollisionPose &pose, double padding)
+{
+  PosedShape posed;
+  posed.type = shape.type;
+  const glm::dquat rotation = pose.rotation * shape.rotation;
+  posed.centre = pose.position + pose.rotation * shape.offset;
+
+  if (shape.type == CollisionShape::kBox)
+  {
+    const glm::dmat3 rotation_matrix = glm::mat3_cast(rotation);
+    posed.inv_rotation = glm::transpose(rotation_matrix);
+    posed.half_extents = shape.half_extents + glm::dvec3(padding);
+    // AABB half extents of the rotated box.
+    glm::dvec3 aabb_half_extents(0);
+    for (int i = 0; i < 3; ++i)
+    {
+      aabb_half_extents += glm::abs(glm::column(rotation_matrix, i)) * posed.half_extents[i];
+    }
+    posed.aabb_min = posed.centre - aabb_half_extents;
+    posed.aabb_max = posed.centre + aabb_half_extents;
+  }
+  else
+  {
+    const glm::dvec3 axis = rotation * glm::dvec3(0, 0, shape.half_length);
+    posed.segment_start = posed.centre - axis;
+    posed.segment_end = posed.centre + axis;
+    posed.radius = shape.radius + padding;
+    posed.aabb_min = glm::min(posed.segment_start, posed.segment_end) - glm::dvec3(posed.radius);
+    posed.aabb_max = glm::max(posed.segment_start, posed.segment_end) + glm::dvec3(posed.radius);
+  }
+
+  return posed;
+}
+
+
+inline bool isObstructed(const CollisionContext &ctx, const QueryCachedRegion &region, const glm::u8vec3 &local_key)
+{
+  if (!region.chunk)
+  {
+    return ctx.unknown_as_occupied;
+  }
+
+  float occupancy = 0;
+  const unsigned voxel_index = voxelIndex(local_key, ctx.region_dim, ctx.occupancy_order);
+  region.buffer.readVoxel(voxel_index, &occupancy);
+  if (occupancy == unobservedOccupancyValue())
+  {
+    return ctx.unknown_as_occupied;
+  }
+  return occupancy >= ctx.occupancy_threshold;
+}
+
+
+/// Rasterise @p shape against the occupancy layer.
+/// @return True on collision, with @p collision_key set to the first obstructed voxel found.
+bool rasteriseShape(const CollisionContext &ctx, CollisionWorker &worker, const PosedShape &shape, Key &collision_key)
+{
+  const glm::ivec3 &dim = ctx.region_dim;
+  const glm::ivec3 min_voxel = globalVoxel(ctx.map->voxelKey(shape.aabb_min), dim);
+  const glm::ivec3 max_voxel = globalVoxel(ctx.map->voxelKey(shape.aabb_max), dim);
+  const glm::dvec3 row_step(ctx.resolution, 0, 0);
+
+  for (int z = min_voxel.z; z <= max_voxel.z; ++z)
+  {
+    const int region_z = floorDiv(z, dim.z);
+    const int local_z = z - region_z * dim.z;
+    for (int y = min_voxel.y; y <= max_voxel.y; ++y)
+    {
+      const int region_y = floorDiv(y, dim.y);
+      const int local_y = y - region_y * dim.y;
+      const glm::dvec3 row_start = ctx.voxel_zero_centre + ctx.resolution * glm::dvec3(0, y, z);
+      const RowInterval interval = shapeRowInterval(shape, row_start, row_step);
+      if (interval.empty())
+      {
+        continue;
+      }
+
+      const int x_begin = std::max(min_voxel.x, int(std::ceil(std::max(interval.lower, double(min_voxel.x)))));
+      const int x_end = std::min(max_voxel.x, int(std::floor(std::min(interval.upper, double(max_voxel.x)))));
+      for (int x = x_begin; x <= x_end;)
+      {
+        // Visit the row one region at a time.
+        const int region_x = floorDiv(x, dim.x);
+        const int region_x_end = std::min(x_end, (region_x + 1) * dim.x - 1);
+        const glm::i16vec3 region_key(region_x, region_y, region_z);
+        const QueryCachedRegion &region = worker.occupancy.region(region_key);
+        if (region.chunk || ctx.unknown_as_occupied)
+        {
+          if (!region.summary || region.summary->regionBrick().mayContainOccupied(ctx.occupancy_threshold,
+                                                                                  ctx.unknown_as_occupied))
+          {
+            for (; x <= region_x_end; ++x)
+            {
+              const glm::u8vec3 local_key(x - region_x * dim.x, local_y, local_z);
+              if (isObstructed(ctx, region, local_key))
+              {
+                collision_key = Key(region_key, local_key);
+                return true;
+              }
+            }
+          }
+        }
+        x = region_x_end + 1;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+/// Test a capsule @p shape by sampling the clearance layer along its segment.
+/// @return True on collision, with @p collision_key set to the voxel at the colliding sample.
+bool clearanceCapsule(const CollisionContext &ctx, CollisionWorker &worker, const PosedShape &shape,
+                      Key &collision_key)
+{
+  const glm::dvec3 axis = shape.segment_end - shape.segment_start;
+  const double length = glm::length(axis);
+  const int sample_count = 1 + int(std::ceil(length / ctx.resolution));
+  const double sample_spacing = (sample_count > 1) ? length / double(sample_count - 1) : 0.0;
+  // Account for the distance from each segment point to the nearest sample, and the sample to its voxel centre.
+  const double required_clearance = shape.radius + 0.5 * sample_spacing + 0.5 * std::sqrt(3.0) * ctx.resolution;
+
+  for (int i = 0; i < sample_count; ++i)
+  {
+    const double t = (sample_count > 1) ? double(i) / double(sample_count - 1) : 0.5;
+    const Key key = ctx.map->voxelKey(shape.segment_start + t * axis);
+    const QueryCachedRegion &region = worker.clearance.region(key.regionKey());
+    if (!region.chunk)
+    {
+      if (ctx.unknown_as_occupied)
+      {
+        collision_key = key;
+        return true;
+      }
+      continue;
+    }
+
+    float clearance = 0;
+    const unsigned voxel_index = voxelIndex(key, ctx.region_dim, ctx.clearance_order);
+    region.buffer.readVoxel(voxel_index, &clearance);
+    if (clearance >= 0 && clearance < required_clearance)
+    {
+      collision_key = key;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/// Test all @p shapes at @p pose .
+bool poseCollides(const CollisionContext &ctx, CollisionWorker &worker, const std::vector<CollisionShape> &shapes,
+                  const CollisionPose &pose, Key &collision_key)
+{
+  for (const auto &shape : shapes)
+  {
+    const PosedShape posed = poseShape(shape, pose, ctx.padding);
+    const bool collides = (posed.type == CollisionShape::kCapsule && ctx.clearance_layer >= 0) ?
+                            clearanceCapsule(ctx, worker, posed, collision_key) :
+                            rasteriseShape(ctx, worker, posed, collision_key);
+    if (collides)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/// Test the volume swept by @p shapes moving from @p start to @p end .
+bool sweepCollides(const CollisionContext &ctx, CollisionWorker &worker, const std::vector<CollisionShape> &shapes,
+                   const CollisionPose &start, const CollisionPose &end, Key &collision_key)
+{
+  // Find the maximum distance any point of the shapes may be from the pose origin.
+  double reach = 0;
+  for (const auto &shape : shapes)
+  {
+    const double shape_reach = (shape.type == CollisionShape::kBox) ? glm::length(shape.half_extents) :
+                                                                       shape.half_length + shape.radius;
+    reach = std::max(reach, glm::length(shape.offset) + shape_reach + ctx.padding);
+  }
+
+  // Bound the motion of any shape point between samples to half a voxel.
+  const double cos_half_angle = std::min(1.0, std::abs(glm::dot(start.rotation, end.rotation)));
+  const double angle = 2.0 * std::acos(cos_half_angle);
+  const double motion = glm::length(end.position - start.position) + angle * reach;
+  const int steps = std::max(1, int(std::ceil(motion / (0.5 * ctx.resolution))));
+
+  for (int i = 0; i <= steps; ++i)
+  {
+    const double t = double(i) / double(steps);
+    CollisionPose pose;
+    pose.position = start.position + t * (end.position - start.position);
+    pose.rotation = glm::slerp(start.rotation, end.rotation, t);
+    if (poseCollides(ctx, worker, shapes, pose, collision_key))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+bool collisionQueryCpu(CollisionQueryDetail &d, bool use_threads)
+{
+  CollisionContext ctx;
+  ctx.map = d.map;
+  ctx.occupancy_layer = d.map->layout().occupancyLayer();
+  if (ctx.occupancy_layer < 0)
+  {
+    return false;
+  }
+
+  ctx.region_dim = glm::ivec3(d.map->regionVoxelDimensions());
+  ctx.resolution = d.map->resolution();
+  ctx.voxel_zero_centre = d.map->voxelCentreGlobal(Key(glm::i16vec3(0), glm::u8vec3(0)));
+  ctx.occupancy_threshold = d.map->occupancyThresholdValue();
+  ctx.occupancy_order = d.map->layerVoxelOrder(ctx.occupancy_layer);
+  ctx.padding = d.padding;
+  ctx.unknown_as_occupied = (d.query_flags & kQfUnknownAsOccupied) != 0;
+
+  if (d.query_flags & CollisionQuery::kQfUseClearance)
+  {
+    const int clearance_layer = d.map->layout().clearanceLayer();
+    if (clearance_layer >= 0)
+    {
+      const MapLayer &layer = d.map->layout().layer(clearance_layer);
+      // Only use a full resolution, single float clearance layer.
+      if (layer.dimensions(d.map->regionVoxelDimensions()) == d.map->regionVoxelDimensions() &&
+          layer.voxelByteSize() == sizeof(float))
+      {
+        ctx.clearance_layer = clearance_layer;
+        ctx.clearance_order = d.map->layerVoxelOrder(clearance_layer);
+      }
+    }
+  }
+
+  const bool sweep = (d.query_flags & CollisionQuery::kQfSweep) != 0;
+  const size_t result_count = (sweep) ? d.poses.size() / 2 : d.poses.size();
+  const size_t block_count = (result_count + kResultsPerBlock - 1) / kResultsPerBlock;
+
+  d.intersected_voxels.resize(result_count);
+  std::fill(d.intersected_voxels.begin(), d.intersected_voxels.end(), Key::kNull);
+
+  const auto evaluate_blocks = [&d, &ctx, sweep, result_count](size_t begin, size_t end) {
+    CollisionWorker worker(ctx);
+    for (size_t i = begin * kResultsPerBlock; i < std::min(end * kResultsPerBlock, result_count); ++i)
+    {
+      Key collision_key = Key::kNull;
+      if (sweep)
+      {
+        sweepCollides(ctx, worker, d.shapes, d.poses[i * 2 + 0], d.poses[i * 2 + 1], collision_key);
+      }
+      else
+      {
+        poseCollides(ctx, worker, d.shapes, d.poses[i], collision_key);
+      }
+      d.intersected_voxels[i] = collision_key;
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, block_count),
+                        [&evaluate_blocks](const tbb::blocked_range<size_t> &range) {
+                          evaluate_blocks(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    evaluate_blocks(0, block_count);
+  }
+
+  d.number_of_results = result_count;
+
+  return true;
+}
+}  // namespace
+
+
+CollisionShape CollisionShape::box(const glm::dvec3 &half_extents, const glm::dvec3 &offset,
+                                   const glm::dquat &rotation)
+{
+  CollisionShape shape;
+  shape.type = kBox;
+  shape.offset = offset;
+  shape.rotation = rotation;
+  shape.half_extents = half_extents;
+  return shape;
+}
+
+
+CollisionShape CollisionShape::capsule(double radius, double half_length, const glm::dvec3 &offset,
+                                       const glm::dquat &rotation)
+{
+  CollisionShape shape;
+  shape.type = kCapsule;
+  shape.offset = offset;
+  shape.rotation = rotation;
+  shape.radius = radius;
+  shape.half_length = half_length;
+  return shape;
+}
+
+
+CollisionQuery::CollisionQuery(CollisionQueryDetail *detail)
+  : Query(detail)
+{}
+
+
+CollisionQuery::CollisionQuery(OccupancyMap &map, unsigned query_flags)
+  : CollisionQuery(query_flags)
+{
+  setMap(&map);
+}
+
+
+CollisionQuery::CollisionQuery(unsigned query_flags)
+  : CollisionQuery(new CollisionQueryDetail)
+{
+  setQueryFlags(query_flags);
+}
+
+
+CollisionQuery::~CollisionQuery()
+{
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
+  CollisionQueryDetail *d = imp();
+  delete d;
+  imp_ = nullptr;
+}
+
+
+void CollisionQuery::setShapes(const CollisionShape *shapes, size_t shape_count)
+{
+  CollisionQueryDetail *d = imp();
+  d->shapes.assign(shapes, shapes + shape_count);
+}
+
+
+const CollisionShape *CollisionQuery::shapes() const
+{
+  const CollisionQueryDetail *d = imp();
+  return d->shapes.data();
+}
+
+
+size_t CollisionQuery::shapeCount() const
+{
+  const CollisionQueryDetail *d = imp();
+  return d->shapes.size();
+}
+
+
+void CollisionQuery::setPoses(const CollisionPose *poses, size_t pose_count)
+{
+  CollisionQueryDetail *d = imp();
+  d->poses.assign(poses, poses + pose_count);
+}
+
+
+const CollisionPose *CollisionQuery::poses() const
+{
+  const CollisionQueryDetail *d = imp();
+  return d->poses.data();
+}
+
+
+size_t CollisionQuery::poseCount() const
+{
+  const CollisionQueryDetail *d = imp();
+  return d->poses.size();
+}
+
+
+double CollisionQuery::padding() const
+{
+  const CollisionQueryDetail *d = imp();
+  return d->padding;
+}
+
+
+void CollisionQuery::setPadding(double padding)
+{
+  CollisionQueryDetail *d = imp();
+  d->padding = std::max(0.0, padding);
+}
+
+
+bool CollisionQuery::collides(size_t result_index) const
+{
+  const CollisionQueryDetail *d = imp();
+  return !d->intersected_voxels[result_index].isNull();
+}
+
+
+bool CollisionQuery::onExecute()
+{
+  CollisionQueryDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return collisionQueryCpu(*d, useThreads());
+}
+
+
+bool CollisionQuery::onExecuteAsync()
+{
+  CollisionQueryDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return executeCpuAsync([this]() { return CollisionQuery::onExecute(); });
+}
+
+
+void CollisionQuery::onReset(bool /*hard_reset*/)
+{
+  // Nothing to reset beyond the base results.
+}
+
+
+CollisionQueryDetail *CollisionQuery::imp()
+{
+  return static_cast<CollisionQueryDetail *>(imp_);
+}
+
+
+const CollisionQueryDetail *CollisionQuery::imp() const
+{
+  return static_cast<const CollisionQueryDetail *>(imp_);
+}
+}  // namespace ohm
@@ -0,0 +1,174 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_COLLISIONQUERY_H
+#define OHM_COLLISIONQUERY_H
+
+#include "OhmConfig.h"
+
+#include "Query.h"
+#include "QueryFlag.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace ohm
+{
+struct CollisionQueryDetail;
+
+/// A collision primitive for a @c CollisionQuery . Shapes are defined relative to a @c CollisionPose .
+struct ohm_API CollisionShape
+{
+  /// Shape types.
+  enum Type : unsigned
+  {
+    /// An oriented box defined by @c half_extents .
+    kBox,
+    /// A capsule of @c radius around a segment of length `2 * half_length` along the shape's local z axis.
+    kCapsule
+  };
+
+  Type type = kBox;                   ///< The shape type.
+  glm::dvec3 offset{ 0 };             ///< Shape centre in the pose frame.
+  glm::dquat rotation{ 1, 0, 0, 0 };  ///< Shape orientation in the pose frame.
+  glm::dvec3 half_extents{ 0 };       ///< Box half extents along the shape's local axes.
+  double radius = 0;                  ///< Capsule radius.
+  double half_length = 0;             ///< Capsule half segment length along the shape's local z axis.
+
+  /// Create a box shape.
+  /// @param half_extents Box half extents.
+  /// @param offset Box centre in the pose frame.
+  /// @param rotation Box orientation in the pose frame.
+  /// @return The box shape.
+  static CollisionShape box(const glm::dvec3 &half_extents, const glm::dvec3 &offset = glm::dvec3(0),
+                            const glm::dquat &rotation = glm::dquat(1, 0, 0, 0));
+
+  /// Create a capsule shape.
+  /// @param radius The capsule radius.
+  /// @param half_length Half the length of the capsule segment, excluding the end caps.
+  /// @param offset Capsule centre in the pose frame.
+  /// @param rotation Capsule orientation in the pose frame. The segment lies along the rotated z axis.
+  /// @return The capsule shape.
+  static CollisionShape capsule(double radius, double half_length, const glm::dvec3 &offset = glm::dvec3(0),
+                                const glm::dquat &rotation = glm::dquat(1, 0, 0, 0));
+};
+
+/// A global pose at which to test the @c CollisionQuery shapes.
+struct ohm_API CollisionPose
+{
+  glm::dvec3 position{ 0 };           ///< Global position.
+  glm::dquat rotation{ 1, 0, 0, 0 };  ///< Global orientation.
+};
+
+/// A batched query testing a robot shaped set of @c CollisionShape primitives for collisions at many poses.
+///
+/// The robot is described by one or more shapes set via @c setShapes() which are tested at each pose set via
+/// @c setPoses() . A pose collides when any shape contains the centre of an obstructed voxel (see @c Query ), with
+/// shapes inflated by the @c padding() . With the @c kQfSweep flag, poses are instead given in start/end pairs and each
+/// pair tests the volume swept by moving the shapes from the start to the end pose. The sweep is sampled such that
+/// successive samples move no point of the shapes by more than half the voxel resolution.
+///
+/// Shapes are rasterised row by row: each voxel row along the x axis is intersected with the shape analytically,
+/// so only voxels inside the shape are visited. Evaluation stops for a pose on the first collision. Poses are split
+/// into blocks evaluated in parallel when built with @c OHM_FEATURE_THREADS and @c useThreads() is set, each reusing
+/// the voxel buffers of recently visited regions.
+///
+/// With the @c kQfUseClearance flag and a map clearance layer (see @c default_layer::clearanceLayerName() ), capsules
+/// are tested by sampling the clearance layer along the capsule segment instead of rasterising the capsule. The
+/// clearance values must be up to date; a negative clearance - no obstruction within the clearance search radius - is
+/// considered free. Boxes are always tested against the occupancy layer.
+///
+/// The @c numberOfResults() matches the number of poses, or pose pairs with @c kQfSweep . For each result, the
+/// @c intersectedVoxels() entry identifies the first colliding voxel found, or is a null @c Key when there is no
+/// collision. @c collides() provides a convenient check. For clearance based capsule tests, this is the voxel at the
+/// colliding segment sample. The @c ranges() are not used.
+///
+/// The @c kQfGpuEvaluate flag is not supported and the query is always evaluated on CPU.
+class ohm_API CollisionQuery : public Query
+{
+public:
+  /// Specialised @c QueryFlag values for this query.
+  enum Flag : unsigned
+  {
+    /// Poses are given in start/end pairs, testing the volume swept between each pair.
+    kQfSweep = kQfSpecialised << 0u,
+    /// Test capsules against the clearance layer when available.
+    kQfUseClearance = kQfSpecialised << 1u,
+  };
+
+protected:
+  /// Constructor used for inherited objects. This supports deriving @p CollisionQueryDetail into
+  /// more specialised forms.
+  /// @param detail pimple style data structure. When null, a @c CollisionQueryDetail is allocated by
+  /// this method.
+  explicit CollisionQuery(CollisionQueryDetail *detail);
+
+public:
+  /// Construct a new query using the given parameters.
+  /// @param map The map to perform the query on.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag and @c CollisionQuery::Flag .
+  explicit CollisionQuery(OccupancyMap &map, unsigned query_flags = kQfUnknownAsOccupied);
+
+  /// Construct a new query using the given parameters.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag and @c CollisionQuery::Flag .
+  explicit CollisionQuery(unsigned query_flags = kQfUnknownAsOccupied);
+
+  /// Destructor.
+  ~CollisionQuery() override;
+
+  /// Set the shapes which make up the robot.
+  /// @param shapes The shapes, defined relative to each pose.
+  /// @param shape_count Number of elements in @p shapes .
+  void setShapes(const CollisionShape *shapes, size_t shape_count);
+
+  /// Get the array of shapes set in the last call to @c setShapes().
+  /// @return The robot shapes. The number of elements is @c shapeCount().
+  const CollisionShape *shapes() const;
+
+  /// Return the number of elements in @c shapes().
+  /// @return The number of shapes.
+  size_t shapeCount() const;
+
+  /// Set the poses to test. With @c kQfSweep , the poses are in start/end pairs.
+  /// @param poses The poses to test.
+  /// @param pose_count Number of elements in @p poses . Expected to be even with @c kQfSweep .
+  void setPoses(const CollisionPose *poses, size_t pose_count);
+
+  /// Get the array of poses set in the last call to @c setPoses().
+  /// @return The poses. The number of elements is @c poseCount().
+  const CollisionPose *poses() const;
+
+  /// Return the number of elements in @c poses().
+  /// @return The number of poses.
+  size_t poseCount() const;
+
+  /// Get the padding used to inflate each shape.
+  /// @return The shape padding.
+  double padding() const;
+  /// Set the padding used to inflate each shape. A padding of half the voxel resolution treats voxels touching a
+  /// shape as colliding in most cases.
+  /// @param padding The new padding. Must be non-negative.
+  void setPadding(double padding);
+
+  /// Check if a result collides. Only valid once execution completes.
+  /// @param result_index The result index. Must be less than @c numberOfResults().
+  /// @return True if the pose, or sweep, at @p result_index collides.
+  bool collides(size_t result_index) const;
+
+protected:
+  bool onExecute() override;
+  bool onExecuteAsync() override;
+  void onReset(bool hard_reset) override;
+
+  /// Access internal details.
+  /// @return Internal details.
+  CollisionQueryDetail *imp();
+  /// Access internal details.
+  /// @return Internal details.
+  const CollisionQueryDetail *imp() const;
+};
+}  // namespace ohm
+
+#endif  // OHM_COLLISIONQUERY_H
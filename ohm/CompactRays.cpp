@@ -0,0 +1,85 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "CompactRays.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ohm
+{
+bool relativeRays(const glm::dvec3 *rays, size_t element_count, const glm::dvec3 &origin,
+                  std::vector<glm::vec3> &relative_rays, double tolerance, double *max_error)
+{
+  relative_rays.resize(element_count);
+  double error = 0;
+  bool ok = true;
+  for (size_t i = 0; i < element_count; ++i)
+  {
+    const glm::dvec3 offset = rays[i] - origin;
+    relative_rays[i] = glm::vec3(offset);
+    const glm::dvec3 delta = glm::abs(glm::dvec3(relative_rays[i]) - offset);
+    const double coord_error = std::max(delta.x, std::max(delta.y, delta.z));
+    ok = ok && coord_error <= tolerance && std::isfinite(offset.x) && std::isfinite(offset.y) &&
+         std::isfinite(offset.z);
+    error = std::max(error, coord_error);
+  }
+
+  if (max_error)
+  {
+    *max_error = error;
+  }
+  return ok;
+}
+
+
+bool quantiseRays(const glm::dvec3 *rays, size_t element_count, const glm::dvec3 &origin, double quantisation,
+                  std::vector<glm::i16vec3> &quantised_rays, double *max_error)
+{
+  const double limit = std::numeric_limits<int16_t>::max();
+  const double inv_quantisation = 1.0 / quantisation;
+  quantised_rays.resize(element_count);
+  double error = 0;
+  bool ok = quantisation > 0;
+  for (size_t i = 0; i < element_count; ++i)
+  {
+    const glm::dvec3 scaled = glm::round((rays[i] - origin) * inv_quantisation);
+    // NaN fails the comparison.
+    ok = ok && glm::all(glm::lessThanEqual(glm::abs(scaled), glm::dvec3(limit)));
+    const glm::dvec3 clamped = glm::clamp(scaled, glm::dvec3(-limit), glm::dvec3(limit));
+    quantised_rays[i] = glm::i16vec3(clamped);
+    if (clamped == scaled)
+    {
+      const glm::dvec3 delta = glm::abs(origin + clamped * quantisation - rays[i]);
+      error = std::max(error, std::max(delta.x, std::max(delta.y, delta.z)));
+    }
+  }
+
+  if (max_error)
+  {
+    *max_error = error;
+  }
+  return ok;
+}
+
+
+void expandRays(const glm::vec3 *relative_rays, size_t element_count, const glm::dvec3 &origin, glm::dvec3 *rays)
+{
+  for (size_t i = 0; i < element_count; ++i)
+  {
+    rays[i] = origin + glm::dvec3(relative_rays[i]);
+  }
+}
+
+
+void expandRays(const glm::i16vec3 *quantised_rays, size_t element_count, const glm::dvec3 &origin,
+                double quantisation, glm::dvec3 *rays)
+{
+  for (size_t i = 0; i < element_count; ++i)
+  {
+    rays[i] = origin + glm::dvec3(quantised_rays[i]) * quantisation;
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,89 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_COMPACTRAYS_H
+#define OHM_COMPACTRAYS_H
+
+#include "OhmConfig.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ohm
+{
+/// @defgroup compactrays Compact ray representations
+/// Utilities for converting origin/sample ray pairs to and from compact, origin relative representations.
+///
+/// Rays are usually given as global, double precision @c glm::dvec3 pairs. Ray sets are typically local to a sensor
+/// so may be expressed relative to a common @c origin - such as the sensor position or a region centre - without
+/// loss of useful precision, halving (single precision) or quartering (quantised) the memory and transfer bandwidth.
+///
+/// - Relative rays use @c glm::vec3 offsets from the @c origin . The conversion error grows with the offset
+///   magnitude, at around `2^-24` relative error, or 3 microns at 50m.
+/// - Quantised rays use @c glm::i16vec3 offsets from the @c origin in units of a @c quantisation step. This covers
+///   `+/-32767 * quantisation` of the origin, with a conversion error of no more than half the step.
+///
+/// The conversion functions validate the precision, failing when the conversion error exceeds a given tolerance or a
+/// quantised offset is out of range.
+/// @{
+
+/// Convert @p rays to single precision offsets from @p origin .
+///
+/// @param rays The global rays. May be any points, but is generally origin/sample pairs.
+/// @param element_count Number of elements in @p rays .
+/// @param origin The origin which the output rays are relative to.
+/// @param[out] relative_rays Resized to hold the converted @p rays .
+/// @param tolerance The maximum error allowed for any coordinate.
+/// @param[out] max_error Optional output for the largest coordinate error of the conversion.
+/// @return True on success, false when any coordinate error exceeds @p tolerance or is not finite. The
+///   @p relative_rays are fully populated either way.
+bool ohm_API relativeRays(const glm::dvec3 *rays, size_t element_count, const glm::dvec3 &origin,
+                          std::vector<glm::vec3> &relative_rays,
+                          double tolerance = std::numeric_limits<double>::infinity(), double *max_error = nullptr);
+
+/// Convert @p rays to quantised offsets from @p origin .
+///
+/// @param rays The global rays. May be any points, but is generally origin/sample pairs.
+/// @param element_count Number of elements in @p rays .
+/// @param origin The origin which the output rays are relative to.
+/// @param quantisation The quantisation step. Must be positive.
+/// @param[out] quantised_rays Resized to hold the converted @p rays . Out of range values are clamped.
+/// @param[out] max_error Optional output for the largest coordinate error of the conversion, excluding out of
+///   range values.
+/// @return True on success, false when any coordinate is outside the quantised range or is not finite.
+bool ohm_API quantiseRays(const glm::dvec3 *rays, size_t element_count, const glm::dvec3 &origin,
+                          double quantisation, std::vector<glm::i16vec3> &quantised_rays, double *max_error = nullptr);
+
+/// Convert single precision, @p origin relative rays to global double precision rays.
+/// @param relative_rays The rays to convert.
+/// @param element_count Number of elements in @p relative_rays .
+/// @param origin The origin which the @p relative_rays are relative to.
+/// @param[out] rays Output array of at least @p element_count elements.
+void ohm_API expandRays(const glm::vec3 *relative_rays, size_t element_count, const glm::dvec3 &origin,
+                        glm::dvec3 *rays);
+
+/// Convert quantised, @p origin relative rays to global double precision rays.
+/// @param quantised_rays The rays to convert.
+/// @param element_count Number of elements in @p quantised_rays .
+/// @param origin The origin which the @p quantised_rays are relative to.
+/// @param quantisation The quantisation step used to quantise the rays.
+/// @param[out] rays Output array of at least @p element_count elements.
+void ohm_API expandRays(const glm::i16vec3 *quantised_rays, size_t element_count, const glm::dvec3 &origin,
+                        double quantisation, glm::dvec3 *rays);
+
+/// Calculate the finest quantisation step which covers offsets of up to @p max_range from the origin.
+/// @param max_range The maximum offset from the origin to support.
+/// @return The smallest quantisation step which can represent @p max_range .
+inline double quantisationForRange(double max_range)
+{
+  return max_range / double(std::numeric_limits<int16_t>::max());
+}
+/// @}
+}  // namespace ohm
+
+#endif  // OHM_COMPACTRAYS_H
@@ -6,14 +6,28 @@
 #include "CompareMaps.h"
 
 #include "Key.h"
+#include "MapChunk.h"
 #include "MapLayer.h"
 #include "MapLayout.h"
 #include "OccupancyMap.h"
+#include "TaskArena.h"
 #include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrder.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
 namespace ohm
@@ -73,6 +87,265 @@ bool compareDatum(const void *val_ptr, const void *ref_ptr, uint64_t tolerance)
   // We do an equality comparison as well as a diff because we may be comparing floating point inf.
   return val == ref || (val - ref) <= epsilon;
 }
+
+
+/// Hash @p size bytes of @p data , consuming 64-bit words with a final bit mixing step.
+uint64_t hashBytes(const uint8_t *data, size_t size)
+{
+  const uint64_t k1 = 0x9e3779b97f4a7c15ull;
+  const uint64_t k2 = 0xbf58476d1ce4e5b9ull;
+  uint64_t hash = 0xcbf29ce484222325ull ^ size;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word = 0;
+    memcpy(&word, data + i, sizeof(word));
+    hash ^= word * k1;
+    hash = ((hash << 31u) | (hash >> 33u)) * k2;
+  }
+  for (; i < size; ++i)
+  {
+    hash ^= data[i] * k1;
+    hash = ((hash << 31u) | (hash >> 33u)) * k2;
+  }
+
+  hash ^= hash >> 30u;
+  hash *= k2;
+  hash ^= hash >> 27u;
+  hash *= 0x94d049bb133111ebull;
+  hash ^= hash >> 31u;
+  return hash;
+}
+
+
+/// Invoke @p func for each index in [0, @p count ), in parallel when @p parallel is set and threads are supported.
+template <typename Func>
+void forEachIndex(size_t count, bool parallel, const Func &func)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (parallel)
+  {
+    parallelExecute([count, &func]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, count), [&func](const tbb::blocked_range<size_t> &range) {
+        for (size_t i = range.begin(); i < range.end(); ++i)
+        {
+          func(i);
+        }
+      });
+    });
+    return;
+  }
+#endif  // OHM_FEATURE_THREADS
+  (void)parallel;
+  for (size_t i = 0; i < count; ++i)
+  {
+    func(i);
+  }
+}
+
+
+/// Check if a region layer is identical in the eval and reference maps, using the @p options hashes when available.
+bool regionsIdentical(const glm::i16vec3 &region_key, const VoxelBuffer<const VoxelBlock> &eval_buffer,
+                      const VoxelBuffer<const VoxelBlock> &ref_buffer, const VoxelsOptions &options)
+{
+  if (!eval_buffer.isValid() || !ref_buffer.isValid())
+  {
+    return false;
+  }
+
+  if (options.eval_hashes && options.ref_hashes)
+  {
+    const auto eval_hash = options.eval_hashes->find(region_key);
+    const auto ref_hash = options.ref_hashes->find(region_key);
+    if (eval_hash != options.eval_hashes->end() && ref_hash != options.ref_hashes->end())
+    {
+      return eval_hash->second == ref_hash->second;
+    }
+  }
+
+  // Group member voxels are interleaved with other layers, so cannot be compared as a block.
+  return !eval_buffer.voxelStride() && !ref_buffer.voxelStride() &&
+         eval_buffer.voxelMemorySize() == ref_buffer.voxelMemorySize() &&
+         std::memcmp(eval_buffer.voxelMemory(), ref_buffer.voxelMemory(), ref_buffer.voxelMemorySize()) == 0;
+}
+
+
+/// Classify an occupancy @p value for @c detectChanges() : zero for unobserved, one for free and two for occupied.
+/// Branch free to allow the classification loop to vectorise.
+inline uint8_t occupancyCode(float value, float threshold)
+{
+  return uint8_t(uint8_t(value < unobservedOccupancyValue()) * uint8_t(1u + uint8_t(value >= threshold)));
+}
+
+
+/// Convert an @c occupancyCode() to an @c OccupancyType .
+inline OccupancyType occupancyCodeType(unsigned code)
+{
+  return (code == 0) ? kUnobserved : ((code == 1) ? kFree : kOccupied);
+}
+
+
+/// Resolve the occupancy values of a region layer in @p target_order . Contiguous layers already in the target order
+/// are used in place, otherwise the values are gathered into @p values . An invalid @p buffer yields unobserved
+/// values.
+const float *regionOccupancy(const VoxelBuffer<const VoxelBlock> &buffer, VoxelOrder buffer_order,
+                             VoxelOrder target_order, const glm::ivec3 &region_dim, std::vector<float> &values)
+{
+  const size_t voxel_count = size_t(region_dim.x) * size_t(region_dim.y) * size_t(region_dim.z);
+  if (!buffer.isValid())
+  {
+    values.assign(voxel_count, unobservedOccupancyValue());
+    return values.data();
+  }
+
+  if (!buffer.voxelStride() && buffer_order == target_order)
+  {
+    return reinterpret_cast<const float *>(buffer.voxelMemory());
+  }
+
+  values.resize(voxel_count);
+  for (unsigned i = 0; i < unsigned(voxel_count); ++i)
+  {
+    const glm::u8vec3 local_key = orderedVoxelLocalKey(i, region_dim, target_order);
+    buffer.readVoxel(voxelIndex(local_key, region_dim, buffer_order), &values[i]);
+  }
+  return values.data();
+}
+
+
+/// Detect the occupancy changes in a single live region. Returns false if the region is identical in both maps and
+/// was skipped.
+bool detectRegionChanges(const MapChunk &live_chunk, const OccupancyMap &live_map, const OccupancyMap &prior_map,
+                         const ChangesOptions &options, std::vector<OccupancyChange> &changes)
+{
+  const int live_layer = live_map.layout().occupancyLayer();
+  const int prior_layer = prior_map.layout().occupancyLayer();
+  const glm::i16vec3 region_key = live_chunk.region.coord;
+  const MapChunk *prior_chunk = prior_map.region(region_key);
+  const VoxelBuffer<const VoxelBlock> live_buffer(live_chunk.voxel_blocks[live_layer]);
+  const VoxelBuffer<const VoxelBlock> prior_buffer =
+    (prior_chunk) ? VoxelBuffer<const VoxelBlock>(prior_chunk->voxel_blocks[prior_layer]) :
+                    VoxelBuffer<const VoxelBlock>();
+  const VoxelOrder live_order = live_map.layerVoxelOrder(live_layer);
+  const VoxelOrder prior_order = prior_map.layerVoxelOrder(prior_layer);
+
+  if (live_order == prior_order && live_map.occupancyThresholdValue() == prior_map.occupancyThresholdValue() &&
+      regionsIdentical(region_key, live_buffer, prior_buffer, VoxelsOptions()))
+  {
+    return false;
+  }
+
+  // Classify both regions in the live voxel order.
+  const glm::ivec3 region_dim = live_map.regionVoxelDimensions();
+  std::vector<float> live_values;
+  std::vector<float> prior_values;
+  const float *live = regionOccupancy(live_buffer, live_order, live_order, region_dim, live_values);
+  const float *prior = regionOccupancy(prior_buffer, prior_order, live_order, region_dim, prior_values);
+  const float live_threshold = live_map.occupancyThresholdValue();
+  const float prior_threshold = prior_map.occupancyThresholdValue();
+  const size_t voxel_count = live_map.regionVoxelVolume();
+  std::vector<uint8_t> codes(voxel_count);
+  for (size_t i = 0; i < voxel_count; ++i)
+  {
+    codes[i] = uint8_t(occupancyCode(live[i], live_threshold) | (occupancyCode(prior[i], prior_threshold) << 2u));
+  }
+
+  for (size_t i = 0; i < voxel_count; ++i)
+  {
+    const unsigned live_code = codes[i] & 3u;
+    const unsigned prior_code = unsigned(codes[i]) >> 2u;
+    if (live_code != prior_code && (options.include_unobserved || (live_code && prior_code)))
+    {
+      OccupancyChange change;
+      change.key = Key(region_key, orderedVoxelLocalKey(unsigned(i), region_dim, live_order));
+      change.prior = occupancyCodeType(prior_code);
+      change.live = occupancyCodeType(live_code);
+      changes.emplace_back(change);
+    }
+  }
+
+  return true;
+}
+
+
+/// Cluster @p changes into blobs of voxels connected by faces, edges or corners.
+void clusterChanges(const OccupancyMap &map, const std::vector<OccupancyChange> &changes, size_t min_blob_size,
+                    std::vector<ChangeBlob> &blobs)
+{
+  std::unordered_map<Key, size_t> change_lookup;
+  change_lookup.reserve(changes.size());
+  for (size_t i = 0; i < changes.size(); ++i)
+  {
+    change_lookup.emplace(changes[i].key, i);
+  }
+
+  const glm::ivec3 region_dim = map.regionVoxelDimensions();
+  std::vector<bool> visited(changes.size(), false);
+  std::deque<size_t> open;
+  ChangeBlob blob;
+  for (size_t seed = 0; seed < changes.size(); ++seed)
+  {
+    if (visited[seed])
+    {
+      continue;
+    }
+
+    // Flood fill the connected changes.
+    blob = ChangeBlob();
+    visited[seed] = true;
+    open.emplace_back(seed);
+    while (!open.empty())
+    {
+      const OccupancyChange &change = changes[open.front()];
+      open.pop_front();
+      blob.keys.emplace_back(change.key);
+      blob.appeared += (change.live == kOccupied) ? 1u : 0u;
+      blob.vanished += (change.prior == kOccupied) ? 1u : 0u;
+
+      glm::ivec3 offset;
+      for (offset.z = -1; offset.z <= 1; ++offset.z)
+      {
+        for (offset.y = -1; offset.y <= 1; ++offset.y)
+        {
+          for (offset.x = -1; offset.x <= 1; ++offset.x)
+          {
+            Key neighbour = change.key;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+              if (offset[axis])
+              {
+                OccupancyMap::stepKey(neighbour, axis, offset[axis], region_dim);
+              }
+            }
+
+            const auto lookup = change_lookup.find(neighbour);
+            if (lookup != change_lookup.end() && !visited[lookup->second])
+            {
+              visited[lookup->second] = true;
+              open.emplace_back(lookup->second);
+            }
+          }
+        }
+      }
+    }
+
+    if (blob.keys.size() < min_blob_size)
+    {
+      continue;
+    }
+
+    blob.min_extents = blob.max_extents = map.voxelCentreGlobal(blob.keys.front());
+    for (const Key &key : blob.keys)
+    {
+      const glm::dvec3 centre = map.voxelCentreGlobal(key);
+      blob.centroid += centre;
+      blob.min_extents = glm::min(blob.min_extents, centre);
+      blob.max_extents = glm::max(blob.max_extents, centre);
+    }
+    blob.centroid /= double(blob.keys.size());
+    blobs.emplace_back(std::move(blob));
+  }
+}
 }  // namespace
 
 bool compareLayoutLayer(const OccupancyMap &eval_map, const OccupancyMap &ref_map, const std::string &layer_name,
@@ -333,10 +606,20 @@ bool compareVoxel(const Key &key, VoxelBuffer<const VoxelBlock> &eval_buffer, Vo
 
 VoxelsResult compareVoxels(const OccupancyMap &eval_map, const OccupancyMap &ref_map, const std::string &layer_name,
                            const MapLayer *tolerance, unsigned flags, Log log)
+{
+  VoxelsOptions options;
+  options.tolerance = tolerance;
+  options.flags = flags;
+  return compareVoxels(eval_map, ref_map, layer_name, options, log);
+}
+
+
+VoxelsResult compareVoxels(const OccupancyMap &eval_map, const OccupancyMap &ref_map, const std::string &layer_name,
+                           const VoxelsOptions &options, Log log)
 {
   VoxelsResult result{};
 
-  result.layout_match = compareLayoutLayer(eval_map, ref_map, layer_name, flags, log);
+  result.layout_match = compareLayoutLayer(eval_map, ref_map, layer_name, options.flags, log);
   if (!result.layout_match)
   {
     // Cannot continue on this failure.
@@ -347,39 +630,203 @@ VoxelsResult compareVoxels(const OccupancyMap &eval_map, const OccupancyMap &ref
   int eval_layer_index = eval_map.layout().layerIndex(layer_name.c_str());
 
   // We've compared layers so we know the indices are valid.
-  VoxelLayoutConst ref_voxel_layout = ref_map.layout().layer(ref_layer_index).voxelLayout();
-  VoxelLayoutConst eval_voxel_layout = eval_map.layout().layer(eval_layer_index).voxelLayout();
+  const VoxelLayoutConst ref_voxel_layout = ref_map.layout().layer(ref_layer_index).voxelLayout();
+  const VoxelLayoutConst eval_voxel_layout = eval_map.layout().layer(eval_layer_index).voxelLayout();
+
+  std::vector<const MapChunk *> ref_chunks;
+  ref_map.enumerateRegions(ref_chunks);
+
+  const bool parallel = (options.flags & kParallel) != 0;
+  // Without kContinue we stop on the first failure.
+  const size_t failure_limit = (options.flags & kContinue) ? options.max_failures : 1u;
+  const glm::ivec3 region_dim = ref_map.regionVoxelDimensions();
+  const size_t region_voxel_count = ref_map.regionVoxelVolume();
+
+  std::atomic<size_t> voxels_passed(0);
+  std::atomic<size_t> voxels_failed(0);
+  std::atomic<size_t> regions_skipped(0);
+  const auto limit_reached = [&voxels_failed, failure_limit]() {
+    return failure_limit > 0 && voxels_failed >= failure_limit;
+  };
+
+  // Serialise logging for parallel comparison.
+  std::mutex log_mutex;
+  Log region_log = log;
+  if (parallel)
+  {
+    region_log = [&log_mutex, &log](Severity severity, const std::string &msg) {
+      std::unique_lock<std::mutex> guard(log_mutex);
+      log(severity, msg);
+    };
+  }
+
+  const auto compare_region = [&](size_t chunk_index) {
+    if (limit_reached())
+    {
+      return;
+    }
+
+    const MapChunk *ref_chunk = ref_chunks[chunk_index];
+    const MapChunk *eval_chunk = eval_map.region(ref_chunk->region.coord);
+
+    VoxelBuffer<const VoxelBlock> ref_buffer(ref_chunk->voxel_blocks[ref_layer_index]);
+    VoxelBuffer<const VoxelBlock> eval_buffer =
+      (eval_chunk) ? VoxelBuffer<const VoxelBlock>(eval_chunk->voxel_blocks[eval_layer_index]) :
+                     VoxelBuffer<const VoxelBlock>();
+
+    if (regionsIdentical(ref_chunk->region.coord, eval_buffer, ref_buffer, options))
+    {
+      voxels_passed += region_voxel_count;
+      ++regions_skipped;
+      return;
+    }
+
+    // Copies for thread safe access to the layout data.
+    VoxelLayoutConst ref_layout = ref_voxel_layout;
+    VoxelLayoutConst eval_layout = eval_voxel_layout;
+    size_t passed = 0;
+    for (int z = 0; z < region_dim.z; ++z)
+    {
+      for (int y = 0; y < region_dim.y; ++y)
+      {
+        for (int x = 0; x < region_dim.x; ++x)
+        {
+          const Key key(ref_chunk->region.coord, uint8_t(x), uint8_t(y), uint8_t(z));
+          if (compareVoxel(key, eval_buffer, eval_layout, ref_buffer, ref_layout, options.tolerance, region_log))
+          {
+            ++passed;
+          }
+          else
+          {
+            ++voxels_failed;
+            if (limit_reached())
+            {
+              voxels_passed += passed;
+              return;
+            }
+          }
+        }
+      }
+    }
+    voxels_passed += passed;
+  };
+
+  forEachIndex(ref_chunks.size(), parallel, compare_region);
+
+  result.voxels_passed = voxels_passed;
+  result.voxels_failed = voxels_failed;
+  result.regions_skipped = regions_skipped;
+  return result;
+}
 
-  VoxelBuffer<const VoxelBlock> ref_buffer;
-  VoxelBuffer<const VoxelBlock> eval_buffer;
 
-  Key last_key = Key(nullptr);
-  const MapChunk *ref_chunk = nullptr;
-  const MapChunk *eval_chunk = nullptr;
-  for (auto key : ref_map)
+uint64_t regionHash(const MapChunk &chunk, int layer_index)
+{
+  VoxelBuffer<const VoxelBlock> buffer(chunk.voxel_blocks[layer_index]);
+  if (buffer.isValid() && buffer.voxelStride())
   {
-    if (last_key.regionKey() != key.regionKey())
+    // Group member: gather the interleaved voxels.
+    const size_t voxel_size = chunk.layout().layer(layer_index).voxelByteSize();
+    std::vector<uint8_t> voxels(buffer.voxelMemorySize());
+    for (size_t i = 0; i < voxels.size() / voxel_size; ++i)
     {
-      // Changed regions. Need to update the voxel buffers.
-      ref_chunk = ref_map.region(key.regionKey());
-      eval_chunk = eval_map.region(key.regionKey());
-
-      ref_buffer = (ref_chunk) ? VoxelBuffer<const VoxelBlock>(ref_chunk->voxel_blocks[ref_layer_index]) :
-                                 VoxelBuffer<const VoxelBlock>();
-      eval_buffer = (eval_chunk) ? VoxelBuffer<const VoxelBlock>(eval_chunk->voxel_blocks[eval_layer_index]) :
-                                   VoxelBuffer<const VoxelBlock>();
+      memcpy(voxels.data() + i * voxel_size, buffer.voxelMemory() + i * buffer.voxelStride(), voxel_size);
     }
+    return hashBytes(voxels.data(), voxels.size());
+  }
+  return (buffer.isValid()) ? hashBytes(buffer.voxelMemory(), buffer.voxelMemorySize()) : 0u;
+}
+
+
+bool regionHashes(const OccupancyMap &map, const std::string &layer_name, RegionHashes &hashes, unsigned flags)
+{
+  hashes.clear();
+  const int layer_index = map.layout().layerIndex(layer_name.c_str());
+  if (layer_index < 0)
+  {
+    return false;
+  }
+
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  std::vector<uint64_t> chunk_hashes(chunks.size());
+  forEachIndex(chunks.size(), (flags & kParallel) != 0,
+               [&](size_t i) { chunk_hashes[i] = regionHash(*chunks[i], layer_index); });
+
+  hashes.reserve(chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    hashes.emplace(chunks[i]->region.coord, chunk_hashes[i]);
+  }
+  return true;
+}
+
+
+ChangesResult detectChanges(const OccupancyMap &live_map, const OccupancyMap &prior_map, const ChangesOptions &options)
+{
+  ChangesResult result{};
+  result.layout_match = live_map.layout().occupancyLayer() >= 0 && prior_map.layout().occupancyLayer() >= 0 &&
+                        live_map.resolution() == prior_map.resolution() &&
+                        live_map.regionVoxelDimensions() == prior_map.regionVoxelDimensions() &&
+                        live_map.origin() == prior_map.origin();
+  if (!result.layout_match)
+  {
+    return result;
+  }
 
-    if (compareVoxel(key, eval_buffer, eval_voxel_layout, ref_buffer, ref_voxel_layout, tolerance, log))
+  // Resolve the live regions to compare.
+  std::vector<const MapChunk *> live_chunks;
+  if (options.regions)
+  {
+    live_chunks.reserve(options.regions->size());
+    for (const auto &region_key : *options.regions)
+    {
+      if (const MapChunk *chunk = live_map.region(region_key))
+      {
+        live_chunks.emplace_back(chunk);
+      }
+    }
+  }
+  else
+  {
+    live_map.enumerateRegions(live_chunks);
+    if (options.since_stamp)
     {
-      ++result.voxels_passed;
+      live_chunks.erase(std::remove_if(live_chunks.begin(), live_chunks.end(),
+                                       [&options](const MapChunk *chunk) {
+                                         return chunk->dirty_stamp <= options.since_stamp;
+                                       }),
+                        live_chunks.end());
     }
-    else
+  }
+
+  // Compare in parallel, then gather the changes in region order.
+  std::vector<std::vector<OccupancyChange>> region_changes(live_chunks.size());
+  std::atomic<size_t> regions_skipped(0);
+  forEachIndex(live_chunks.size(), (options.flags & kParallel) != 0, [&](size_t i) {
+    if (!detectRegionChanges(*live_chunks[i], live_map, prior_map, options, region_changes[i]))
     {
-      ++result.voxels_failed;
-      OHM_CMP_FAIL(flags, result);
+      ++regions_skipped;
     }
-    last_key = key;
+  });
+
+  size_t change_count = 0;
+  for (const auto &changes : region_changes)
+  {
+    change_count += changes.size();
+  }
+  result.changes.reserve(change_count);
+  for (const auto &changes : region_changes)
+  {
+    result.changes.insert(result.changes.end(), changes.begin(), changes.end());
+  }
+
+  result.regions_compared = live_chunks.size();
+  result.regions_skipped = regions_skipped;
+
+  if (options.cluster)
+  {
+    clusterChanges(live_map, result.changes, options.min_blob_size, result.blobs);
   }
 
   return result;
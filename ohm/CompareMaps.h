@@ -8,12 +8,17 @@
 
 #include "OhmConfig.h"
 
+#include "Key.h"
+#include "MapRegion.h"
+#include "OccupancyType.h"
 #include "VoxelBlock.h"
 #include "VoxelBuffer.h"
 #include "VoxelLayout.h"
 
 #include <functional>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #define OHM_CMP_FAIL(flags, ret)              \
   if (((flags)&ohm::compare::kContinue) == 0) \
@@ -23,8 +28,8 @@
 
 namespace ohm
 {
-class Key;
 class OccupancyMap;
+struct MapChunk;
 
 /// An experimental set of functions for comparing maps.
 namespace compare
@@ -40,16 +45,18 @@ enum class Severity
 /// Comparison flag values.
 enum Flag : unsigned
 {
-  kZero = 0u,             ///< Zero value.
-  kContinue = (1u << 0u)  ///< Continue on error.
+  kZero = 0u,              ///< Zero value.
+  kContinue = (1u << 0u),  ///< Continue on error.
+  kParallel = (1u << 1u)   ///< Compare regions in parallel. Requires @c OHM_FEATURE_THREADS , ignored otherwise.
 };
 
 /// Results on comparing voxels
 struct ohm_API VoxelsResult
 {
-  size_t voxels_passed = 0;   ///< Number of voxels passed.
-  size_t voxels_failed = 0;   ///< Number of voxels failed.
-  bool layout_match = false;  ///< Results of layout check. Must pass to compare content.
+  size_t voxels_passed = 0;    ///< Number of voxels passed.
+  size_t voxels_failed = 0;    ///< Number of voxels failed.
+  size_t regions_skipped = 0;  ///< Number of identical regions passed without comparing voxels.
+  bool layout_match = false;   ///< Results of layout check. Must pass to compare content.
 
   /// Conversion to bool value.
   explicit inline operator bool() const { return voxels_failed == 0 && layout_match; }
@@ -58,6 +65,81 @@ struct ohm_API VoxelsResult
 /// Logging function type.
 using Log = std::function<void(Severity, const std::string &)>;
 
+/// Content hashes for the regions of one map layer, keyed on region coordinates. See @c regionHashes() .
+using RegionHashes = std::unordered_map<glm::i16vec3, uint64_t, MapRegion::Hash>;
+
+/// Extended options for @c compareVoxels() .
+struct ohm_API VoxelsOptions
+{
+  /// A dummy @c MapLayer object which wraps the allowed tolerances for differences in voxel member values. See
+  /// @c compareVoxel() .
+  const MapLayer *tolerance = nullptr;
+  /// See @c Flag values.
+  unsigned flags = 0;
+  /// Stop after this many voxel failures when @c kContinue is set. Zero for no limit. With @c kParallel , a few more
+  /// failures may be reported before all regions stop.
+  size_t max_failures = 0;
+  /// Optional precomputed region hashes for the eval map layer. Used with @c ref_hashes to skip regions with matching
+  /// hashes. Otherwise identical regions are detected by comparing the region voxel memory.
+  const RegionHashes *eval_hashes = nullptr;
+  /// Optional precomputed region hashes for the reference map layer.
+  const RegionHashes *ref_hashes = nullptr;
+};
+
+/// An occupancy state change for a voxel reported by @c detectChanges() .
+struct ohm_API OccupancyChange
+{
+  Key key;                            ///< The changed voxel.
+  OccupancyType prior = kUnobserved;  ///< The state in the prior map.
+  OccupancyType live = kUnobserved;   ///< The state in the live map.
+};
+
+/// A connected group of changed voxels reported by @c detectChanges() .
+struct ohm_API ChangeBlob
+{
+  std::vector<Key> keys;          ///< The changed voxels in the blob.
+  glm::dvec3 centroid{ 0.0 };     ///< Mean of the voxel centres.
+  glm::dvec3 min_extents{ 0.0 };  ///< Minimum extents of the voxel centres.
+  glm::dvec3 max_extents{ 0.0 };  ///< Maximum extents of the voxel centres.
+  size_t appeared = 0;            ///< Number of voxels which became occupied.
+  size_t vanished = 0;            ///< Number of voxels which were occupied, but no longer are.
+};
+
+/// Options for @c detectChanges() .
+struct ohm_API ChangesOptions
+{
+  /// Only compare live map regions with a @c MapChunk::dirty_stamp greater than this. Zero compares all live
+  /// regions. Generally the live map @c OccupancyMap::stamp() when the prior map was captured.
+  uint64_t since_stamp = 0;
+  /// Optional explicit list of live regions to compare, such as those drained from a @c RegionChangeFeed . This
+  /// avoids scanning all regions for dirty stamps and overrides @c since_stamp .
+  const std::vector<glm::i16vec3> *regions = nullptr;
+  /// See @c Flag values. Only @c kParallel is used.
+  unsigned flags = 0;
+  /// Report changes to and from the unobserved state? Otherwise only changes between free and occupied are
+  /// reported.
+  bool include_unobserved = false;
+  /// Cluster the changes into @c ChangeBlob items?
+  bool cluster = true;
+  /// Blobs with fewer voxels are not reported. Their voxels remain in @c ChangesResult::changes .
+  size_t min_blob_size = 1;
+};
+
+/// Results of @c detectChanges() .
+struct ohm_API ChangesResult
+{
+  /// The changed voxels ordered by region.
+  std::vector<OccupancyChange> changes;
+  /// The changes clustered into voxels connected by faces, edges or corners.
+  std::vector<ChangeBlob> blobs;
+  size_t regions_compared = 0;  ///< Number of live regions compared.
+  size_t regions_skipped = 0;   ///< Number of identical regions passed without comparing voxels.
+  bool layout_match = false;    ///< True when the maps are spatially compatible and have occupancy layers.
+
+  /// Conversion to bool value: true when the maps could be compared.
+  explicit inline operator bool() const { return layout_match; }
+};
+
 /// Empty/dummy logging function.
 inline void ohm_API emptyLog(Severity /*severity*/, const std::string & /*msg*/){};
 
@@ -140,6 +222,56 @@ VoxelsResult ohm_API compareVoxels(const OccupancyMap &eval_map, const Occupancy
                                    const std::string &layer_name, const MapLayer *tolerance = nullptr,
                                    unsigned flags = 0, Log log = emptyLog);
 
+/// Compare the layer content for all voxels in @p ref_map with extended options.
+///
+/// Regions which are byte identical in both maps pass without comparing individual voxels and are counted in
+/// @c VoxelsResult::regions_skipped . The remaining regions are compared voxel by voxel, in parallel with
+/// @c kParallel , in which case calls to @p log are serialised, but not ordered.
+///
+/// @param eval_map The map to evaluate.
+/// @param ref_map The reference map.
+/// @param layer_name The name fo the layer to compare voxel content.
+/// @param options Comparison options.
+/// @param log Logging function.
+/// @return False if any validation step fails.
+VoxelsResult ohm_API compareVoxels(const OccupancyMap &eval_map, const OccupancyMap &ref_map,
+                                   const std::string &layer_name, const VoxelsOptions &options, Log log = emptyLog);
+
+/// Calculate a content hash for the voxel memory of a region layer.
+/// @param chunk The region of interest.
+/// @param layer_index The @c MapLayout layer index.
+/// @return The 64-bit content hash.
+uint64_t ohm_API regionHash(const MapChunk &chunk, int layer_index);
+
+/// Calculate the @c regionHash() for every region of a map layer. The results may be stored by the caller and used
+/// in later calls to @c compareVoxels() via @c VoxelsOptions .
+/// @param map The map to hash.
+/// @param layer_name The name of the layer to hash.
+/// @param[out] hashes Populated with the region hashes. Cleared first.
+/// @param flags See @c Flag values. Only @c kParallel is used.
+/// @return False if @p map does not have the layer.
+bool ohm_API regionHashes(const OccupancyMap &map, const std::string &layer_name, RegionHashes &hashes,
+                          unsigned flags = 0);
+
+/// Detect voxels whose occupancy state differs between a @p live_map and a @p prior_map , such as a map built on
+/// an earlier visit.
+///
+/// Unlike @c compareVoxels() , this is intended to run online. Only the live regions changed since
+/// @c ChangesOptions::since_stamp - or listed in @c ChangesOptions::regions - are compared. Byte identical regions
+/// are skipped, then each remaining region is classified in a single pass over the occupancy values of both maps,
+/// in parallel across regions with @c kParallel . Each map's occupancy threshold is used to classify its own
+/// voxels. Regions missing from the prior map are treated as unobserved. Regions missing from the live map are not
+/// compared, so the removal of live regions is not reported.
+///
+/// The maps must have the same resolution, region dimensions and origin.
+///
+/// @param live_map The current map.
+/// @param prior_map The map to compare against.
+/// @param options Change detection options.
+/// @return The changes. @c ChangesResult::layout_match is false if the maps cannot be compared.
+ChangesResult ohm_API detectChanges(const OccupancyMap &live_map, const OccupancyMap &prior_map,
+                                    const ChangesOptions &options = ChangesOptions());
+
 
 /// Configure a data tolerance value for @c member_name. The allowed absolute error tolerance is @p epsilon.
 ///
@@ -12,11 +12,17 @@
 #include "MapLayer.h"
 #include "MapRegionCache.h"
 #include "OccupancyMap.h"
+#include "TaskArena.h"
 #include "VoxelBlock.h"
 #include "VoxelBuffer.h"
 
 #include <glm/glm.hpp>
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
 #include <cstring>
 
 namespace
@@ -24,10 +30,30 @@ namespace
 void copyChunkLayerUnsafe(ohm::MapChunk &dst_chunk, unsigned dst_layer, const ohm::MapChunk &src_chunk,
                           unsigned src_layer)
 {
+  // Try copy the block as stored first. The overlapping layer set ensures the layouts match.
+  if (dst_chunk.voxel_blocks[dst_layer]->copyFrom(*src_chunk.voxel_blocks[src_layer]))
+  {
+    return;
+  }
+
   ohm::VoxelBuffer<ohm::VoxelBlock> dst_buffer(dst_chunk.voxel_blocks[dst_layer]);
   ohm::VoxelBuffer<const ohm::VoxelBlock> src_buffer(src_chunk.voxel_blocks[src_layer]);
 
-  memcpy(dst_buffer.voxelMemory(), src_buffer.voxelMemory(), src_buffer.voxelMemorySize());
+  if (!dst_buffer.voxelStride() && !src_buffer.voxelStride())
+  {
+    memcpy(dst_buffer.voxelMemory(), src_buffer.voxelMemory(), src_buffer.voxelMemorySize());
+    return;
+  }
+
+  // Either layer is a group member with interleaved voxels. Copy each voxel.
+  const size_t voxel_size = dst_chunk.layout().layer(dst_layer).voxelByteSize();
+  const size_t dst_stride = (dst_buffer.voxelStride()) ? dst_buffer.voxelStride() : voxel_size;
+  const size_t src_stride = (src_buffer.voxelStride()) ? src_buffer.voxelStride() : voxel_size;
+  const size_t voxel_count = src_buffer.voxelMemorySize() / voxel_size;
+  for (size_t i = 0; i < voxel_count; ++i)
+  {
+    memcpy(dst_buffer.voxelMemory() + i * dst_stride, src_buffer.voxelMemory() + i * src_stride, voxel_size);
+  }
 }
 }  // namespace
 
@@ -52,11 +78,12 @@ CopyChunkFilter copyFilterStamp(uint64_t after_stamp)
 bool canCopy(const OccupancyMap &dst, const OccupancyMap &src)
 {
   return &src != &dst && src.resolution() == dst.resolution() &&
-         src.regionVoxelDimensions() == dst.regionVoxelDimensions() && src.origin() == dst.origin();
+         src.regionVoxelDimensions() == dst.regionVoxelDimensions() && src.origin() == dst.origin() &&
+         src.voxelOrder() == dst.voxelOrder();
 }
 
 bool copyMap(OccupancyMap &dst, const OccupancyMap &src, const CopyChunkFilter &copy_chunk_filter,
-             const CopyLayerFilter &copy_layer_filter)
+             const CopyLayerFilter &copy_layer_filter, unsigned flags)
 {
   if (!canCopy(dst, src))
   {
@@ -114,6 +141,9 @@ bool copyMap(OccupancyMap &dst, const OccupancyMap &src, const CopyChunkFilter &
   }
 
   const int tsdf_layer_index = dst_layout.layerIndex(default_layer::tsdfLayerName());
+
+  // Resolve the included chunks and create the destination chunks from this thread.
+  std::vector<std::pair<MapChunk *, const MapChunk *>> chunk_pairs;
   for (const auto &src_iter : src_detail.chunks)
   {
     if (!src_iter.second || (copy_chunk_filter && !copy_chunk_filter(*src_iter.second)))
@@ -122,11 +152,12 @@ bool copyMap(OccupancyMap &dst, const OccupancyMap &src, const CopyChunkFilter &
       continue;
     }
 
-    const MapChunk &src_chunk = *src_iter.second;
-    MapChunk &dst_chunk = *dst.region(src_iter.first, true);
-    assert(&dst_chunk);
+    MapChunk *dst_chunk = dst.region(src_iter.first, true);
+    assert(dst_chunk);
+    chunk_pairs.emplace_back(dst_chunk, src_iter.second);
+  }
 
-    // Included chunk.
+  const auto copy_chunk = [&](MapChunk &dst_chunk, const MapChunk &src_chunk) {
     // First try copy via the GPU cache.
     for (size_t i = 0; i < layer_overlap.size(); ++i)
     {
@@ -159,6 +190,29 @@ bool copyMap(OccupancyMap &dst, const OccupancyMap &src, const CopyChunkFilter &
         }
       }
     }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  // GPU layer cache synchronisation must remain serial.
+  if ((flags & kCopyParallel) && !src_detail.gpu_cache)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, chunk_pairs.size()),
+                        [&chunk_pairs, &copy_chunk](const tbb::blocked_range<size_t> &range) {
+                          for (size_t i = range.begin(); i < range.end(); ++i)
+                          {
+                            copy_chunk(*chunk_pairs[i].first, *chunk_pairs[i].second);
+                          }
+                        });
+    });
+    return true;
+  }
+#endif  // OHM_FEATURE_THREADS
+
+  (void)flags;
+  for (const auto &chunk_pair : chunk_pairs)
+  {
+    copy_chunk(*chunk_pair.first, *chunk_pair.second);
   }
 
   return true;
@@ -20,6 +20,16 @@ namespace ohm
 class OccupancyMap;
 struct MapChunk;
 
+/// Flags for @c copyMap() .
+enum CopyFlag : unsigned
+{
+  /// Default, serial copy.
+  kCopyDefault = 0u,
+  /// Copy regions in parallel using a thread pool. Requires @c OHM_FEATURE_THREADS , otherwise ignored. Also ignored
+  /// when the source map has a GPU cache, which must be synchronised serially.
+  kCopyParallel = (1u << 0u)
+};
+
 /// Filter used to determine if a chunk should be copied. Note that an empty filter always indicates an implied pass.
 /// This is relevant to logical operations applied to filter functions.
 using CopyChunkFilter = std::function<bool(const MapChunk &chunk)>;
@@ -125,6 +135,7 @@ inline CopyLayerFilter ohm_API copyFilterNegate(const CopyLayerFilter &filter)
 ///   - have the same resolution
 ///   - have the same region size
 ///   - have the same origin
+///   - have the same @c OccupancyMap::voxelOrder() so voxel memory may be copied directly
 /// - The @p dst map is not being modifies by another thread (not enforced).
 ///
 /// @param src The map to copy from.
@@ -138,6 +149,9 @@ bool ohm_API canCopy(const OccupancyMap &dst, const OccupancyMap &src);
 /// - @c canCopy() must pass.
 /// - The maps must have common map layers matched by name and voxel layout.
 ///
+/// Layer voxel data are copied as stored, so compressed or uniform source blocks are copied without uncompressing
+/// them. The filters are always called from the calling thread, even with @c kCopyParallel .
+///
 /// @note This is not currently threadsafe.
 ///
 /// @param dst The map to copy into.
@@ -145,8 +159,9 @@ bool ohm_API canCopy(const OccupancyMap &dst, const OccupancyMap &src);
 /// @param copy_chunk_filter Optional @c MapChunk filter to apply restricting what is copied.
 /// @param copy_layer_filter Optional filter function for determining which layers are copied from the source map,
 /// provided they exist in the destination map. Only source layers which pass the filter function are copied.
+/// @param flags @c CopyFlag values.
 bool ohm_API copyMap(OccupancyMap &dst, const OccupancyMap &src, const CopyChunkFilter &copy_chunk_filter = {},
-                     const CopyLayerFilter &copy_layer_filter = {});
+                     const CopyLayerFilter &copy_layer_filter = {}, unsigned flags = kCopyDefault);
 }  // namespace ohm
 
 #endif  // OHM_COPYUTIL_H
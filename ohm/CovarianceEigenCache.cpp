@@ -0,0 +1,273 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "CovarianceEigenCache.h"
+
+#include "CovarianceVoxel.h"
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "MapRegion.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "VoxelSpan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ohm
+{
+namespace
+{
+/// The cached decomposition for a region.
+struct RegionEigen
+{
+  /// Decomposition for each voxel in covariance layer voxel order.
+  std::vector<CovarianceEigen> voxels;
+  /// Index converting local keys to @c voxels indices.
+  VoxelKeyDecoder decoder;
+  /// The covariance layer @c MapChunk::layerTouchedStamp() at the time of calculation.
+  uint64_t stamp = 0;
+  /// Set once the region has been calculated.
+  bool valid = false;
+};
+
+
+/// (Re)calculate the decomposition for @p chunk into @p entry .
+void calculateRegion(const OccupancyMap &map, const MapChunk &chunk, int covariance_layer, RegionEigen &entry)
+{
+  // Capture the stamp before reading the voxels so we err on the side of recalculating on concurrent modification.
+  entry.stamp = chunk.layerTouchedStamp(unsigned(covariance_layer));
+  const VoxelSpan<const CovarianceVoxel> covariance(&chunk, map, covariance_layer);
+  entry.valid = covariance.isValid();
+  if (!entry.valid)
+  {
+    entry.voxels.clear();
+    return;
+  }
+
+  entry.decoder = covariance.keyDecoder();
+  entry.voxels.resize(covariance.size());
+
+  CovarianceEigenBatch batch;
+  glm::dmat3 axes;
+  glm::dvec3 values;
+  for (size_t batch_start = 0; batch_start < covariance.size(); batch_start += kCovarianceBatchWidth)
+  {
+    const size_t batch_end = std::min(batch_start + kCovarianceBatchWidth, covariance.size());
+    batch.count = 0;
+    for (size_t i = batch_start; i < batch_end; ++i)
+    {
+      batch.add(covariance[i]);
+    }
+
+    covarianceEigenDecompositionBatch(batch);
+
+    for (unsigned lane = 0; lane < batch.count; ++lane)
+    {
+      batch.getDecomposition(lane, &axes, &values);
+      CovarianceEigen &eigen = entry.voxels[batch_start + lane];
+      eigen.axes = glm::mat3(axes);
+      eigen.values = glm::vec3(values);
+    }
+  }
+}
+}  // namespace
+
+
+/// Pimpl data for @c CovarianceEigenCache .
+struct CovarianceEigenCacheDetail
+{
+  /// The cached map.
+  const OccupancyMap *map = nullptr;
+  /// Cached regions by region key.
+  std::unordered_map<glm::i16vec3, RegionEigen, MapRegion::Hash> regions;
+
+  /// Query the covariance layer index.
+  /// @return The covariance layer index, or -1 if there is no covariance layer.
+  inline int covarianceLayer() const { return map->layout().covarianceLayer(); }
+
+  /// Query if @p entry is up to date with @p chunk .
+  inline bool isCurrent(const RegionEigen &entry, const MapChunk &chunk, int covariance_layer) const
+  {
+    return entry.valid && entry.stamp == chunk.layerTouchedStamp(unsigned(covariance_layer));
+  }
+};
+
+
+void CovarianceEigen::unitSphereTransformation(glm::dquat *rotation, glm::dvec3 *scale) const
+{
+  // As for covarianceUnitSphereTransformation(), but the axes already form a rotation matrix.
+  *rotation = glm::dquat(glm::dmat3(axes));
+  for (int i = 0; i < 3; ++i)
+  {
+    const double eval = std::abs(double(values[i]));  // abs just in case.
+    const double epsilon = 1e-9;
+    (*scale)[i] = (eval > epsilon) ? std::sqrt(eval) : eval;
+  }
+}
+
+
+glm::dvec3 CovarianceEigen::primaryNormal() const
+{
+  // The eigenvalues are in ascending order, so the first axis has the smallest eigenvalue.
+  const glm::dvec3 normal(axes[0]);
+  const double length2 = glm::dot(normal, normal);
+  return (length2 > 0) ? normal / std::sqrt(length2) : normal;
+}
+
+
+CovarianceEigenCache::CovarianceEigenCache(const OccupancyMap &map)
+  : imp_(std::make_unique<CovarianceEigenCacheDetail>())
+{
+  imp_->map = &map;
+}
+
+
+CovarianceEigenCache::~CovarianceEigenCache() = default;
+
+
+const OccupancyMap &CovarianceEigenCache::map() const
+{
+  return *imp_->map;
+}
+
+
+bool CovarianceEigenCache::isValid() const
+{
+  return imp_->covarianceLayer() >= 0;
+}
+
+
+const CovarianceEigen *CovarianceEigenCache::region(const MapChunk &chunk)
+{
+  const int covariance_layer = imp_->covarianceLayer();
+  if (covariance_layer < 0)
+  {
+    return nullptr;
+  }
+
+  RegionEigen &entry = imp_->regions[chunk.region.coord];
+  if (!imp_->isCurrent(entry, chunk, covariance_layer))
+  {
+    calculateRegion(*imp_->map, chunk, covariance_layer, entry);
+  }
+
+  return (entry.valid) ? entry.voxels.data() : nullptr;
+}
+
+
+const CovarianceEigen *CovarianceEigenCache::currentRegion(const MapChunk &chunk) const
+{
+  const int covariance_layer = imp_->covarianceLayer();
+  if (covariance_layer < 0)
+  {
+    return nullptr;
+  }
+
+  const auto search = imp_->regions.find(chunk.region.coord);
+  if (search == imp_->regions.end() || !imp_->isCurrent(search->second, chunk, covariance_layer))
+  {
+    return nullptr;
+  }
+
+  return search->second.voxels.data();
+}
+
+
+bool CovarianceEigenCache::voxel(const Key &key, CovarianceEigen *eigen)
+{
+  const MapChunk *chunk = (!key.isNull()) ? imp_->map->region(key.regionKey()) : nullptr;
+  const CovarianceEigen *voxels = (chunk) ? region(*chunk) : nullptr;
+  if (!voxels)
+  {
+    return false;
+  }
+
+  *eigen = voxels[imp_->regions[chunk->region.coord].decoder.index(key.localKey())];
+  return true;
+}
+
+
+bool CovarianceEigenCache::currentVoxel(const Key &key, CovarianceEigen *eigen) const
+{
+  const MapChunk *chunk = (!key.isNull()) ? imp_->map->region(key.regionKey()) : nullptr;
+  const CovarianceEigen *voxels = (chunk) ? currentRegion(*chunk) : nullptr;
+  if (!voxels)
+  {
+    return false;
+  }
+
+  *eigen = voxels[imp_->regions.find(chunk->region.coord)->second.decoder.index(key.localKey())];
+  return true;
+}
+
+
+size_t CovarianceEigenCache::update(bool use_threads)
+{
+  CovarianceEigenCacheDetail &imp = *imp_;
+  const int covariance_layer = imp.covarianceLayer();
+  if (covariance_layer < 0)
+  {
+    imp.regions.clear();
+    return 0;
+  }
+
+  std::vector<const MapChunk *> chunks;
+  imp.map->enumerateRegions(chunks);
+
+  // Release regions which are no longer in the map.
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> live_regions;
+  live_regions.reserve(chunks.size());
+  for (const MapChunk *chunk : chunks)
+  {
+    live_regions.emplace(chunk->region.coord);
+  }
+  for (auto iter = imp.regions.begin(); iter != imp.regions.end();)
+  {
+    iter = (live_regions.find(iter->first) == live_regions.end()) ? imp.regions.erase(iter) : std::next(iter);
+  }
+
+  // Resolve the out of date regions, creating their entries up front so the parallel calculation does not modify the
+  // region table.
+  std::vector<const MapChunk *> stale_chunks;
+  std::vector<RegionEigen *> stale_entries;
+  for (const MapChunk *chunk : chunks)
+  {
+    RegionEigen &entry = imp.regions[chunk->region.coord];
+    if (!imp.isCurrent(entry, *chunk, covariance_layer))
+    {
+      stale_chunks.emplace_back(chunk);
+      stale_entries.emplace_back(&entry);
+    }
+  }
+
+  const OccupancyMap &map = *imp.map;
+  parallelForEachRegion(
+    stale_chunks,
+    [&map, &stale_entries, covariance_layer](const MapChunk &chunk, size_t region_index, unsigned /*worker_index*/) {
+      calculateRegion(map, chunk, covariance_layer, *stale_entries[region_index]);
+    },
+    use_threads);
+
+  return stale_chunks.size();
+}
+
+
+void CovarianceEigenCache::clear()
+{
+  imp_->regions.clear();
+}
+
+
+size_t CovarianceEigenCache::regionCount() const
+{
+  return imp_->regions.size();
+}
+}  // namespace ohm
@@ -0,0 +1,129 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_COVARIANCEEIGENCACHE_H
+#define OHM_COVARIANCEEIGENCACHE_H
+
+#include "OhmConfig.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/vec3.hpp>
+
+#include <memory>
+
+namespace ohm
+{
+class Key;
+class OccupancyMap;
+struct MapChunk;
+struct CovarianceEigenCacheDetail;
+
+/// The principal axes and eigenvalues of a @c CovarianceVoxel as held by a @c CovarianceEigenCache .
+struct ohm_API CovarianceEigen
+{
+  /// The principal axes as the matrix columns, ordered to match @c values . The axes form a rotation matrix.
+  glm::mat3 axes{ 1.0f };
+  /// The covariance eigenvalues in ascending order.
+  glm::vec3 values{ 0.0f };
+
+  /// Convert into a rotation and scale factors to deform a unit sphere to approximate the covariance cluster. This is
+  /// equivalent to @c covarianceUnitSphereTransformation() .
+  /// @param[out] rotation The quaternion rotation to apply to the unit sphere after applying @p scale .
+  /// @param[out] scale The scaling to apply to the unit sphere before @p rotation .
+  void unitSphereTransformation(glm::dquat *rotation, glm::dvec3 *scale) const;
+
+  /// Estimate the primary normal as the axis with the smallest eigenvalue. This is equivalent to
+  /// @c covarianceEstimatePrimaryNormal() with the default axis preference.
+  /// @return The unit normal estimate.
+  glm::dvec3 primaryNormal() const;
+};
+
+/// A lazily updated cache of the @c CovarianceEigen decomposition for each voxel of an @c OccupancyMap with a
+/// covariance layer.
+///
+/// Consumers such as covariance ellipsoid exports, NDT visualisation and surface normal estimation otherwise repeat the
+/// @c covarianceEigenDecomposition() of each voxel every time they visit it. The cache holds the decomposition for
+/// each voxel of the regions it has visited, keyed by region. A region is recalculated only when the
+/// @c MapChunk::layerTouchedStamp() for the covariance layer shows the covariance has changed since the last
+/// calculation. Recalculation uses @c covarianceEigenDecompositionBatch() over the whole region.
+///
+/// The decomposition is held in single precision, costing 48 bytes per voxel of each cached region. The cache does not
+/// track region removal; call @c update() or @c clear() after culling regions.
+///
+/// Threading:
+/// - @c update() brings all regions up to date, potentially in parallel, and is intended to be called before threaded
+///   reads.
+/// - @c currentRegion() and @c currentVoxel() only read the cache and may be called concurrently.
+/// - @c region() and @c voxel() may update the cache and must not be called concurrently.
+/// - The map must not be modified while the cache is being read or updated.
+class ohm_API CovarianceEigenCache
+{
+public:
+  /// Create a cache for @p map .
+  /// @param map The map to cache the covariance decomposition of. Must outlive this object.
+  explicit CovarianceEigenCache(const OccupancyMap &map);
+  /// Destructor.
+  ~CovarianceEigenCache();
+
+  CovarianceEigenCache(const CovarianceEigenCache &) = delete;
+  CovarianceEigenCache &operator=(const CovarianceEigenCache &) = delete;
+
+  /// Access the cached map.
+  /// @return The map.
+  const OccupancyMap &map() const;
+
+  /// Query if the map has a covariance layer and the cache can be used.
+  /// @return True if the map has a covariance layer.
+  bool isValid() const;
+
+  /// Access the decomposition for each voxel of @p chunk , recalculating it if missing or out of date. Not threadsafe.
+  ///
+  /// The array is addressed by the covariance layer voxel index - see @c voxelIndex() and
+  /// @c OccupancyMap::layerVoxelOrder() . The array remains valid until the region is next recalculated or the cache
+  /// is cleared.
+  ///
+  /// @param chunk A chunk of the cached map.
+  /// @return The region decomposition, or null if the map has no covariance layer.
+  const CovarianceEigen *region(const MapChunk &chunk);
+
+  /// Access the decomposition for each voxel of @p chunk only if it is up to date. This does not modify the cache and
+  /// may be called concurrently. See @c region() .
+  /// @param chunk A chunk of the cached map.
+  /// @return The region decomposition, or null if it is missing or out of date.
+  const CovarianceEigen *currentRegion(const MapChunk &chunk) const;
+
+  /// Fetch the decomposition for the voxel at @p key , recalculating its region if missing or out of date. Not
+  /// threadsafe.
+  /// @param key The voxel of interest.
+  /// @param[out] eigen Set to the voxel decomposition on success.
+  /// @return True on success, false when the region does not exist or the map has no covariance layer.
+  bool voxel(const Key &key, CovarianceEigen *eigen);
+
+  /// Fetch the decomposition for the voxel at @p key only if its region is up to date. May be called concurrently.
+  /// @param key The voxel of interest.
+  /// @param[out] eigen Set to the voxel decomposition on success.
+  /// @return True on success, false when the region is missing or out of date.
+  bool currentVoxel(const Key &key, CovarianceEigen *eigen) const;
+
+  /// Bring the cache up to date with every region of the map. Only regions with a changed covariance layer are
+  /// recalculated, and cached regions no longer in the map are released.
+  /// @param use_threads Allow regions to be recalculated in parallel? See @c parallelForEachRegion() .
+  /// @return The number of regions recalculated.
+  size_t update(bool use_threads = true);
+
+  /// Release all cached regions.
+  void clear();
+
+  /// Query the number of cached regions.
+  /// @return The cached region count.
+  size_t regionCount() const;
+
+private:
+  std::unique_ptr<CovarianceEigenCacheDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_COVARIANCEEIGENCACHE_H
@@ -32,7 +32,9 @@
 #include <shapes/3esshapes.h>
 #endif  // TES_ENABLE
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 
 namespace ohm
 {
@@ -142,6 +144,238 @@ void covarianceEigenDecompositionGlm(const CovarianceVoxel *cov, glm::dmat3 *eig
   *eigenvalues = eigenvalues_current;
 }
 #endif  // OHM_FEATURE_EIGEN
+
+/// Unpacked covariance matrices for a @c CovarianceHitBatch . See @c unpackCovariance() for the layout.
+template <typename Real>
+using UnpackedCovarianceBatch = Real[9][kCovarianceBatchWidth];  // NOLINT(modernize-avoid-c-arrays)
+
+/// Lane equivalent of @c packedDot() .
+template <typename Real>
+inline Real packedDotLane(const UnpackedCovarianceBatch<Real> &matrix, const int j, const int k, unsigned lane)
+{
+  const int col_first_el[] = { 0, 1, 3 };  // NOLINT(modernize-avoid-c-arrays)
+  const int indj = col_first_el[j];
+  const int indk = col_first_el[k];
+  const int m = (j <= k) ? j : k;
+  Real d = matrix[6 + k][lane] * matrix[6 + j][lane];  // NOLINT(readability-magic-numbers)
+  for (int i = 0; i <= m; ++i)
+  {
+    d += matrix[indj + i][lane] * matrix[indk + i][lane];
+  }
+  return d;
+}
+
+
+/// Implementation of @c calculateHitWithCovarianceBatch() with the covariance maths in @c Real precision.
+template <typename Real>
+void calculateHitWithCovarianceBatchT(CovarianceHitBatch &batch, float hit_value, float uninitialised_value,
+                                      float voxel_resolution, float reinitialise_threshold,
+                                      unsigned reinitialise_sample_count)
+{
+  // This follows calculateHitWithCovariance() and unpackCovariance() exactly, operation for operation, so the results
+  // match for double precision. Branches on the voxel state are replaced with selection so the lane loops may be
+  // vectorised.
+  const float covariance_scale_factor = 0.1f;  // As per initialiseCovariance()
+  const float initial_covariance = covariance_scale_factor * voxel_resolution;
+  UnpackedCovarianceBatch<Real> unpacked;
+
+  for (unsigned lane = 0; lane < kCovarianceBatchWidth; ++lane)
+  {
+    const float initial_value = batch.voxel_value[lane];
+    const bool was_uncertain = initial_value == uninitialised_value;
+    const bool reset = batch.point_count[lane] == 0 ||
+                       (initial_value < reinitialise_threshold && batch.point_count[lane] >= reinitialise_sample_count);
+    const unsigned point_count = (!reset) ? batch.point_count[lane] : 0u;
+
+    batch.covariance[0][lane] = (!reset) ? batch.covariance[0][lane] : initial_covariance;
+    batch.covariance[1][lane] = (!reset) ? batch.covariance[1][lane] : 0.0f;
+    batch.covariance[2][lane] = (!reset) ? batch.covariance[2][lane] : initial_covariance;
+    batch.covariance[3][lane] = (!reset) ? batch.covariance[3][lane] : 0.0f;
+    batch.covariance[4][lane] = (!reset) ? batch.covariance[4][lane] : 0.0f;
+    batch.covariance[5][lane] = (!reset) ? batch.covariance[5][lane] : initial_covariance;
+    batch.voxel_value[lane] = (!was_uncertain) ? hit_value + initial_value : hit_value;
+    batch.reset_mean[lane] = reset;
+
+    const Real one_on_num_pt_plus_one = Real(1) / (Real(point_count) + Real(1));
+    const Real sc_1 = point_count ? std::sqrt(Real(point_count) * one_on_num_pt_plus_one) : Real(1);
+    const Real sc_2 = one_on_num_pt_plus_one * std::sqrt(Real(point_count));
+    for (int i = 0; i < 6; ++i)  // NOLINT(readability-magic-numbers)
+    {
+      unpacked[i][lane] = sc_1 * Real(batch.covariance[i][lane]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      // Subtract in double precision as the sample and mean are global coordinates. The difference is small.
+      const Real sample_to_mean = Real((!reset) ? batch.sample[i][lane] - batch.voxel_mean[i][lane] : 0.0);
+      unpacked[i + 6][lane] = sc_2 * sample_to_mean;  // NOLINT(readability-magic-numbers)
+    }
+  }
+
+  // Modified Gram-Schmidt decomposition. See calculateHitWithCovariance().
+  for (int k = 0; k < 3; ++k)
+  {
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    const int ind1 = (k * (k + 3)) >> 1;  // packed index of (k,k) term
+    const int indk = ind1 - k;            // packed index of (1,k)
+    Real aki[kCovarianceBatchWidth];      // NOLINT(modernize-avoid-c-arrays)
+    bool valid[kCovarianceBatchWidth];    // NOLINT(modernize-avoid-c-arrays)
+    for (unsigned lane = 0; lane < kCovarianceBatchWidth; ++lane)
+    {
+      const Real ak = std::sqrt(packedDotLane(unpacked, k, k, lane));
+      batch.covariance[ind1][lane] = float(ak);
+      valid[lane] = ak > 0;
+      aki[lane] = (valid[lane]) ? Real(1) / ak : Real(0);
+    }
+
+    for (int j = k + 1; j < 3; ++j)
+    {
+      const int indj = (j * (j + 1)) >> 1;  // NOLINT(hicpp-signed-bitwise)
+      const int indkj = indj + k;
+      for (unsigned lane = 0; lane < kCovarianceBatchWidth; ++lane)
+      {
+        Real c = packedDotLane(unpacked, j, k, lane) * aki[lane];
+        batch.covariance[indkj][lane] = (valid[lane]) ? float(c) : batch.covariance[indkj][lane];
+        c *= aki[lane];
+        // NOLINTNEXTLINE(readability-magic-numbers)
+        const Real mean_term = unpacked[j + 6][lane] - c * unpacked[k + 6][lane];
+        unpacked[j + 6][lane] = (valid[lane]) ? mean_term : unpacked[j + 6][lane];  // NOLINT(readability-magic-numbers)
+        for (int l = 0; l <= k; ++l)
+        {
+          const Real term = unpacked[indj + l][lane] - c * unpacked[indk + l][lane];
+          unpacked[indj + l][lane] = (valid[lane]) ? term : unpacked[indj + l][lane];
+        }
+      }
+    }
+  }
+}
+
+
+/// Calculate a unit eigenvector of the symmetric matrix with upper triangle @p a for the eigenvalue @p eval . This
+/// selects the largest cross product of the rows of `A - eval * I` , which is orthogonal to the row space. Requires
+/// @p eval to be a distinct eigenvalue.
+/// @param a Upper triangle of the matrix: a00, a01, a02, a11, a12, a22.
+/// @param eval The eigenvalue.
+/// @param[out] v The unit eigenvector.
+inline void symmetricEigenvectorLane(const double a[6], double eval, double v[3])  // NOLINT(modernize-avoid-c-arrays)
+{
+  const double m00 = a[0] - eval;
+  const double m11 = a[3] - eval;
+  const double m22 = a[5] - eval;  // NOLINT(readability-magic-numbers)
+  // Cross products of row pairs: r0 x r1, r0 x r2, r1 x r2.
+  const double c0[3] = { a[1] * a[4] - a[2] * m11, a[2] * a[1] - m00 * a[4], m00 * m11 - a[1] * a[1] };
+  const double c1[3] = { a[1] * m22 - a[2] * a[4], a[2] * a[2] - m00 * m22, m00 * a[4] - a[1] * a[2] };
+  const double c2[3] = { m11 * m22 - a[4] * a[4], a[4] * a[2] - a[1] * m22, a[1] * a[4] - m11 * a[2] };
+  const double l0 = c0[0] * c0[0] + c0[1] * c0[1] + c0[2] * c0[2];
+  const double l1 = c1[0] * c1[0] + c1[1] * c1[1] + c1[2] * c1[2];
+  const double l2 = c2[0] * c2[0] + c2[1] * c2[1] + c2[2] * c2[2];
+  const bool use0 = l0 >= l1 && l0 >= l2;
+  const bool use1 = !use0 && l1 >= l2;
+  const double length2 = (use0) ? l0 : ((use1) ? l1 : l2);
+  const double inv_length = (length2 > 0) ? 1.0 / std::sqrt(length2) : 0.0;
+  for (int i = 0; i < 3; ++i)
+  {
+    v[i] = ((use0) ? c0[i] : ((use1) ? c1[i] : c2[i])) * inv_length;
+  }
+  // Fallback to the X axis should the rows be degenerate.
+  v[0] = (length2 > 0) ? v[0] : 1.0;
+}
+
+
+/// Closed form eigen decomposition of a single lane of a @c CovarianceEigenBatch . See
+/// @c covarianceEigenDecompositionBatch() .
+///
+/// The eigenvalues are found from the characteristic polynomial using the trigonometric solution. The eigenvector for
+/// the most isolated eigenvalue is found first via @c symmetricEigenvectorLane() . The middle eigenvector is solved in
+/// the plane orthogonal to the first, which remains stable for repeated eigenvalues. The last is their cross product.
+inline void covarianceEigenDecompositionLane(CovarianceEigenBatch &batch, unsigned lane)
+{
+  const double third_turn = 2.0943951023931957;  // 2 pi / 3
+  // Unpack A = S * S^T from the square root covariance. See covarianceSqrtMatrix().
+  const double t0 = batch.covariance[0][lane];
+  const double t1 = batch.covariance[1][lane];
+  const double t2 = batch.covariance[2][lane];
+  const double t3 = batch.covariance[3][lane];
+  const double t4 = batch.covariance[4][lane];
+  const double t5 = batch.covariance[5][lane];  // NOLINT(readability-magic-numbers)
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays)
+  const double a[6] = { t0 * t0, t0 * t1, t0 * t3, t1 * t1 + t2 * t2, t1 * t3 + t2 * t4, t3 * t3 + t4 * t4 + t5 * t5 };
+
+  const double q = (a[0] + a[3] + a[5]) / 3.0;  // NOLINT(readability-magic-numbers)
+  const double b00 = a[0] - q;
+  const double b11 = a[3] - q;
+  const double b22 = a[5] - q;  // NOLINT(readability-magic-numbers)
+  const double off_diagonal2 = a[1] * a[1] + a[2] * a[2] + a[4] * a[4];
+  const double p = std::sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * off_diagonal2) / 6.0);
+  // Treat near equal eigenvalues as isotropic, including a zero covariance.
+  const double relative_epsilon = 1e-12;
+  const bool distinct = p > relative_epsilon * std::abs(q);
+  const double inv_p = (distinct) ? 1.0 / p : 0.0;
+  const double half_det_b = 0.5 * inv_p * inv_p * inv_p *
+                            (b00 * (b11 * b22 - a[4] * a[4]) - a[1] * (a[1] * b22 - a[4] * a[2]) +
+                             a[2] * (a[1] * a[4] - b11 * a[2]));
+  const double phi = std::acos(std::min(1.0, std::max(-1.0, half_det_b))) / 3.0;
+  const double eval_max = q + 2.0 * p * std::cos(phi);
+  const double eval_min = q + 2.0 * p * std::cos(phi + third_turn);
+  const double eval_mid = 3.0 * q - eval_max - eval_min;
+
+  // Solve the most isolated eigenvalue first.
+  const bool max_first = eval_max - eval_mid >= eval_mid - eval_min;
+  double v_first[3];  // NOLINT(modernize-avoid-c-arrays)
+  symmetricEigenvectorLane(a, (max_first) ? eval_max : eval_min, v_first);
+
+  // Build an orthonormal basis {u, w} of the plane orthogonal to v_first.
+  const bool x_major = std::abs(v_first[0]) > std::abs(v_first[1]);
+  double u[3] = { (x_major) ? -v_first[2] : 0.0, (x_major) ? 0.0 : v_first[2],  // NOLINT(modernize-avoid-c-arrays)
+                  (x_major) ? v_first[0] : -v_first[1] };
+  const double inv_u_length = 1.0 / std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+  u[0] *= inv_u_length;
+  u[1] *= inv_u_length;
+  u[2] *= inv_u_length;
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays)
+  const double w[3] = { v_first[1] * u[2] - v_first[2] * u[1], v_first[2] * u[0] - v_first[0] * u[2],
+                        v_first[0] * u[1] - v_first[1] * u[0] };
+
+  // Project M = A - eval_mid * I into the plane and find the null vector of the 2x2 result.
+  const double mu[3] = { (a[0] - eval_mid) * u[0] + a[1] * u[1] + a[2] * u[2],  // NOLINT(modernize-avoid-c-arrays)
+                         a[1] * u[0] + (a[3] - eval_mid) * u[1] + a[4] * u[2],
+                         a[2] * u[0] + a[4] * u[1] + (a[5] - eval_mid) * u[2] };
+  const double mw[3] = { (a[0] - eval_mid) * w[0] + a[1] * w[1] + a[2] * w[2],  // NOLINT(modernize-avoid-c-arrays)
+                         a[1] * w[0] + (a[3] - eval_mid) * w[1] + a[4] * w[2],
+                         a[2] * w[0] + a[4] * w[1] + (a[5] - eval_mid) * w[2] };
+  const double m00 = u[0] * mu[0] + u[1] * mu[1] + u[2] * mu[2];
+  const double m01 = u[0] * mw[0] + u[1] * mw[1] + u[2] * mw[2];
+  const double m11 = w[0] * mw[0] + w[1] * mw[1] + w[2] * mw[2];
+  const bool row0 = std::abs(m00) >= std::abs(m11);
+  double x = (row0) ? -m01 : m11;
+  double y = (row0) ? m00 : -m01;
+  const double xy_length2 = x * x + y * y;
+  const double inv_xy_length = (xy_length2 > 0) ? 1.0 / std::sqrt(xy_length2) : 0.0;
+  x = (xy_length2 > 0) ? x * inv_xy_length : 1.0;
+  y *= inv_xy_length;
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays)
+  const double v_mid[3] = { x * u[0] + y * w[0], x * u[1] + y * w[1], x * u[2] + y * w[2] };
+  // NOLINTNEXTLINE(modernize-avoid-c-arrays)
+  const double v_last[3] = { v_first[1] * v_mid[2] - v_first[2] * v_mid[1],
+                             v_first[2] * v_mid[0] - v_first[0] * v_mid[2],
+                             v_first[0] * v_mid[1] - v_first[1] * v_mid[0] };
+
+  // Order by ascending eigenvalue. {v_first, v_mid, v_last} is right handed, so {v_last, v_mid, v_first} is left
+  // handed and the minimum eigenvector is negated to form a rotation matrix.
+  batch.eigenvalues[0][lane] = (distinct) ? eval_min : q;
+  batch.eigenvalues[1][lane] = (distinct) ? eval_mid : q;
+  batch.eigenvalues[2][lane] = (distinct) ? eval_max : q;
+  for (int i = 0; i < 3; ++i)
+  {
+    const double v_min = (max_first) ? -v_last[i] : v_first[i];
+    const double v_max = (max_first) ? v_first[i] : v_last[i];
+    const double identity_i = (i == 0) ? 1.0 : 0.0;
+    const double identity_j = (i == 1) ? 1.0 : 0.0;
+    const double identity_k = (i == 2) ? 1.0 : 0.0;
+    batch.eigenvectors[0 + i][lane] = (distinct) ? v_min : identity_i;
+    batch.eigenvectors[3 + i][lane] = (distinct) ? v_mid[i] : identity_j;
+    batch.eigenvectors[6 + i][lane] = (distinct) ? v_max : identity_k;  // NOLINT(readability-magic-numbers)
+  }
+}
 }  // namespace
 
 void covarianceEigenDecomposition(const CovarianceVoxel *cov, glm::dmat3 *eigenvectors, glm::dvec3 *eigenvalues)
@@ -215,6 +449,30 @@ void covDebugStats()
 }
 #endif  // OHM_COV_DEBUG
 
+void calculateHitWithCovarianceBatch(CovarianceHitBatch &batch, float hit_value, float uninitialised_value,
+                                     float voxel_resolution, float reinitialise_threshold,
+                                     unsigned reinitialise_sample_count, bool single_precision)
+{
+  if (single_precision)
+  {
+    calculateHitWithCovarianceBatchT<float>(batch, hit_value, uninitialised_value, voxel_resolution,
+                                            reinitialise_threshold, reinitialise_sample_count);
+  }
+  else
+  {
+    calculateHitWithCovarianceBatchT<double>(batch, hit_value, uninitialised_value, voxel_resolution,
+                                             reinitialise_threshold, reinitialise_sample_count);
+  }
+}
+
+void covarianceEigenDecompositionBatch(CovarianceEigenBatch &batch)
+{
+  for (unsigned lane = 0; lane < kCovarianceBatchWidth; ++lane)
+  {
+    covarianceEigenDecompositionLane(batch, lane);
+  }
+}
+
 void integrateNdtHit(NdtMap &map, const Key &key, const glm::dvec3 &sensor, const glm::dvec3 &sample, bool ndt_tm,
                      const float sample_intensity)
 {
@@ -102,6 +102,153 @@ inline glm::dmat3 covarianceMatrix(const CovarianceVoxel *cov)
 void covDebugStats();
 #endif  // OHM_COV_DEBUG
 
+/// @ingroup voxelcovariance
+/// Number of voxels updated in lock step by @c calculateHitWithCovarianceBatch() .
+constexpr unsigned kCovarianceBatchWidth = 8u;
+
+/// @ingroup voxelcovariance
+/// Structure of arrays voxel state for @c calculateHitWithCovarianceBatch() . Per component arrays are indexed
+/// `[component][lane]` .
+///
+/// Each lane holds the state of a different voxel, matching the arguments of @c calculateHitWithCovariance() .
+/// Lanes `[count, kCovarianceBatchWidth)` are still processed, but their results are ignored.
+struct ohm_API CovarianceHitBatch
+{
+  /// @c CovarianceVoxel::trianglar_covariance for each lane.
+  float covariance[6][kCovarianceBatchWidth]{};  // NOLINT(readability-magic-numbers, modernize-avoid-c-arrays)
+  float voxel_value[kCovarianceBatchWidth]{};     ///< Occupancy value for each lane.
+  double sample[3][kCovarianceBatchWidth]{};      ///< Sample position for each lane.
+  double voxel_mean[3][kCovarianceBatchWidth]{};  ///< Voxel mean position for each lane.
+  unsigned point_count[kCovarianceBatchWidth]{};  ///< Voxel mean point count for each lane.
+  /// Output: was the covariance reinitialised for each lane? See @c calculateHitWithCovariance() return value.
+  bool reset_mean[kCovarianceBatchWidth]{};
+  /// Number of lanes in use.
+  unsigned count = 0;
+
+  /// Set the state of the next lane, incrementing the @c count . The @c count must be less than
+  /// @c kCovarianceBatchWidth .
+  /// @param cov The voxel covariance.
+  /// @param voxel_value The voxel occupancy value.
+  /// @param sample The sample which falls in the voxel.
+  /// @param voxel_mean The current voxel mean position.
+  /// @param point_count The voxel mean point count.
+  /// @return The lane index.
+  inline unsigned add(const CovarianceVoxel &cov, float voxel_value, const glm::dvec3 &sample,
+                      const glm::dvec3 &voxel_mean, unsigned point_count)
+  {
+    const unsigned lane = count++;
+    for (int i = 0; i < 6; ++i)  // NOLINT(readability-magic-numbers)
+    {
+      covariance[i][lane] = cov.trianglar_covariance[i];
+    }
+    this->voxel_value[lane] = voxel_value;
+    for (int i = 0; i < 3; ++i)
+    {
+      this->sample[i][lane] = sample[i];
+      this->voxel_mean[i][lane] = voxel_mean[i];
+    }
+    this->point_count[lane] = point_count;
+    return lane;
+  }
+
+  /// Extract the covariance for @p lane .
+  /// @param lane The lane of interest.
+  /// @param[out] cov Set to the lane covariance.
+  inline void getCovariance(unsigned lane, CovarianceVoxel *cov) const
+  {
+    for (int i = 0; i < 6; ++i)  // NOLINT(readability-magic-numbers)
+    {
+      cov->trianglar_covariance[i] = covariance[i][lane];
+    }
+  }
+};
+
+/// @ingroup voxelcovariance
+/// Calculate a voxel hit with packed covariance for each lane of @p batch .
+///
+/// This is equivalent to calling @c calculateHitWithCovariance() for each lane, with matching results, but processes
+/// @c kCovarianceBatchWidth voxels at once without branching on the voxel state to support vectorisation. The
+/// @c CovarianceHitBatch::covariance and @c CovarianceHitBatch::voxel_value are updated for each lane and the
+/// @c CovarianceHitBatch::reset_mean set.
+///
+/// Each lane must reference a different voxel as the updates are independent.
+///
+/// The covariance update uses double precision by default. Setting @p single_precision performs the update in single
+/// precision instead, doubling the lanes processed per SIMD instruction. The results then only approximate
+/// @c calculateHitWithCovariance() , which is generally acceptable as the covariance is stored in single precision.
+///
+/// @param[in,out] batch The voxels to update.
+/// @param hit_value The log probability value increase for occupancy on a hit.
+/// @param uninitialised_value The voxel value for an uncertain voxel - one which has yet to be observed.
+/// @param voxel_resolution The voxel size along each cubic edge.
+/// @param reinitialise_threshold Voxel value threshold below which the covariance and mean should reset.
+/// @param reinitialise_sample_count The point count required to allow @c reinitialise_threshold to be triggered.
+/// @param single_precision True to update the covariance using single precision maths.
+void ohm_API calculateHitWithCovarianceBatch(CovarianceHitBatch &batch, float hit_value, float uninitialised_value,
+                                             float voxel_resolution, float reinitialise_threshold,
+                                             unsigned reinitialise_sample_count, bool single_precision = false);
+
+/// @ingroup voxelcovariance
+/// Structure of arrays covariance state for @c covarianceEigenDecompositionBatch() . Per component arrays are indexed
+/// `[component][lane]` .
+struct ohm_API CovarianceEigenBatch
+{
+  /// @c CovarianceVoxel::trianglar_covariance for each lane.
+  float covariance[6][kCovarianceBatchWidth]{};  // NOLINT(readability-magic-numbers, modernize-avoid-c-arrays)
+  /// Output: eigenvalues for each lane in ascending order.
+  double eigenvalues[3][kCovarianceBatchWidth]{};  // NOLINT(modernize-avoid-c-arrays)
+  /// Output: eigenvectors for each lane, matching the order of @c eigenvalues . Component `[c * 3 + r]` is element
+  /// `r` of eigenvector `c` , the column major layout of a @c glm::dmat3 . The eigenvectors form a rotation matrix.
+  double eigenvectors[9][kCovarianceBatchWidth]{};  // NOLINT(readability-magic-numbers, modernize-avoid-c-arrays)
+  /// Number of lanes in use.
+  unsigned count = 0;
+
+  /// Set the covariance of the next lane, incrementing the @c count . The @c count must be less than
+  /// @c kCovarianceBatchWidth .
+  /// @param cov The voxel covariance.
+  /// @return The lane index.
+  inline unsigned add(const CovarianceVoxel &cov)
+  {
+    const unsigned lane = count++;
+    for (int i = 0; i < 6; ++i)  // NOLINT(readability-magic-numbers)
+    {
+      covariance[i][lane] = cov.trianglar_covariance[i];
+    }
+    return lane;
+  }
+
+  /// Extract the decomposition results for @p lane .
+  /// @param lane The lane of interest.
+  /// @param[out] eigenvectors Set to the lane eigenvectors.
+  /// @param[out] eigenvalues Set to the lane eigenvalues.
+  inline void getDecomposition(unsigned lane, glm::dmat3 *eigenvectors, glm::dvec3 *eigenvalues) const
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      (*eigenvalues)[c] = this->eigenvalues[c][lane];
+      for (int r = 0; r < 3; ++r)
+      {
+        (*eigenvectors)[c][r] = this->eigenvectors[c * 3 + r][lane];
+      }
+    }
+  }
+};
+
+/// @ingroup voxelcovariance
+/// Perform an eigen decomposition of the covariance in each lane of @p batch .
+///
+/// This uses a closed form solution for the symmetric 3x3 covariance matrix rather than the iterative solver of
+/// @c covarianceEigenDecomposition() , with selection in place of branching so the lane loops may be vectorised. It is
+/// intended for bulk recalculation, such as by @c CovarianceEigenCache . The results match
+/// @c covarianceEigenDecomposition() to within numerical precision, excepting the sign and, for repeated eigenvalues,
+/// the choice of eigenvectors. Lanes with a degenerate covariance, such as a zero covariance, yield identity
+/// eigenvectors.
+///
+/// All @c kCovarianceBatchWidth lanes are processed regardless of the @c CovarianceEigenBatch::count .
+///
+/// @param[in,out] batch The covariance values to decompose.
+void ohm_API covarianceEigenDecompositionBatch(CovarianceEigenBatch &batch);
+
 /// Integrate a hit result for a single voxel of @p map with NDT or NDT-TM support. The NDT-TM is used when
 /// @p ndt_tm is true and and the layers @c default_layer::intensityLayerName() and
 /// @c default_layer::hitMissCountLayerName() layers are available to update @c IntensityMeanCov and @c HitMissCount
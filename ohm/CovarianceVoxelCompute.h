@@ -467,18 +467,23 @@ inline __device__ void calculateHitMissUpdateOnHit(CovarianceVoxel *cov_voxel, f
   const unsigned initial_hit = (!needs_reset) ? hit_miss_count->hit_count : 0;
   const unsigned initial_miss = (!needs_reset) ? hit_miss_count->miss_count : 0;
 
-  CovReal p_x_ml_given_voxel;
-  CovReal p_x_ml_given_sample;
-  // FIXME(KS): This is calculated both here and in calculateMissNdt(). We need only calculate once and share the
-  // results
-  calculateSampleLikelihoods(cov_voxel, sensor, sample, voxel_mean, sensor_noise, &p_x_ml_given_voxel,
-                             &p_x_ml_given_sample);
+  // The likelihoods only affect the counts once the covariance is usable. Skip the triangular solves otherwise as these
+  // dominate the cost of the NDT-TM hit update.
+  const bool use_ndt = !needs_reset && point_count >= sample_threshold;
+  CovReal p_x_ml_given_voxel = 0;
+  CovReal p_x_ml_given_sample = 0;
+  if (use_ndt)
+  {
+    // FIXME(KS): This is calculated both here and in calculateMissNdt(). We need only calculate once and share the
+    // results
+    calculateSampleLikelihoods(cov_voxel, sensor, sample, voxel_mean, sensor_noise, &p_x_ml_given_voxel,
+                               &p_x_ml_given_sample);
+  }
   const CovReal prod = p_x_ml_given_voxel * p_x_ml_given_sample;
   const CovReal eta = kHalf * adaptation_rate;  // NOLINT
 
-  const bool inc_hit =
-    needs_reset || point_count < sample_threshold || (point_count >= sample_threshold && prod >= eta);
-  const bool inc_miss = !needs_reset && point_count >= sample_threshold && prod < eta && p_x_ml_given_voxel >= eta;
+  const bool inc_hit = !use_ndt || prod >= eta;
+  const bool inc_miss = use_ndt && prod < eta && p_x_ml_given_voxel >= eta;
 
   // Logically we should yield the following results:
   // 1. needs_reset is true:
@@ -7,8 +7,11 @@
 
 #include "MapLayer.h"
 #include "MapLayout.h"
+#include "VoxelClearanceChannels.h"
+#include "VoxelEsdf.h"
 #include "VoxelMean.h"
 #include "VoxelSecondarySample.h"
+#include "VoxelTouchIncident.h"
 #include "VoxelTsdf.h"
 
 #include <algorithm>
@@ -46,6 +49,10 @@ const char *clearanceLayerName()
 {
   return "clearance";
 }
+const char *clearanceChannelsLayerName()
+{
+  return "clearance_channels";
+}
 const char *intensityLayerName()
 {
   return "intensity";
@@ -62,6 +69,10 @@ const char *incidentNormalLayerName()
 {
   return "incident_normal";
 }
+const char *touchIncidentLayerName()
+{
+  return "touch_incident";
+}
 const char *tsdfLayerName()
 {
   return "tsdf";
@@ -70,6 +81,24 @@ const char *secondarySamplesLayerName()
 {
   return "secondary_samples";
 }
+const char *esdfLayerName()
+{
+  return "esdf";
+}
+const char *occupancyMaskLayerName()
+{
+  return "occupancy_mask";
+}
+const char *occupancyStateLayerName()
+{
+  return "occupancy_state";
+}
+
+
+const char *occupancyGroupLayerName()
+{
+  return "occupancy_group";
+}
 }  // namespace default_layer
 
 
@@ -195,6 +224,32 @@ MapLayer *addClearance(MapLayout &layout)
   return layer;
 }
 
+MapLayer *addClearanceChannels(MapLayout &layout)
+{
+  int layer_index = layout.layerIndex(default_layer::clearanceChannelsLayerName());
+  if (layer_index != -1)
+  {
+    // Already present.
+    return layout.layerPtr(layer_index);
+  }
+
+  MapLayer *layer = layout.addLayer(default_layer::clearanceChannelsLayerName());
+
+  const float default_clearance = -1.0f;
+  size_t clear_value = 0;
+  memcpy(&clear_value, &default_clearance, std::min(sizeof(default_clearance), sizeof(clear_value)));
+  layer->voxelLayout().addMember("horizontal", DataType::kFloat, clear_value);
+  layer->voxelLayout().addMember("overhead", DataType::kFloat, clear_value);
+
+  if (layer->voxelByteSize() != sizeof(VoxelClearanceChannels))
+  {
+    throw std::runtime_error("VoxelClearanceChannels layer size mismatch");
+  }
+
+  return layer;
+}
+
+
 MapLayer *addIntensity(MapLayout &layout)
 {
   if (const MapLayer *layer = layout.layer(default_layer::intensityLayerName()))
@@ -285,6 +340,28 @@ MapLayer *addIncidentNormal(MapLayout &layout)
   return layer;
 }
 
+MapLayer *addTouchIncident(MapLayout &layout)
+{
+  int layer_index = layout.layerIndex(default_layer::touchIncidentLayerName());
+  if (layer_index != -1)
+  {
+    // Already present.
+    return layout.layerPtr(layer_index);
+  }
+
+  MapLayer *layer = layout.addLayer(default_layer::touchIncidentLayerName());
+  VoxelLayout voxel = layer->voxelLayout();
+  voxel.addMember("touch", DataType::kUInt32, 0);
+  voxel.addMember("packed_normal", DataType::kUInt32, 0);
+
+  if (layer->voxelByteSize() != sizeof(VoxelTouchIncident))
+  {
+    throw std::runtime_error("Touch incident layer size mismatch");
+  }
+
+  return layer;
+}
+
 
 MapLayer *addTsdf(MapLayout &layout)
 {
@@ -334,4 +411,112 @@ MapLayer ohm_API *addSecondarySamples(MapLayout &layout)
 
   return layer;
 }
+
+MapLayer *addEsdf(MapLayout &layout)
+{
+  int layer_index = layout.layerIndex(default_layer::esdfLayerName());
+  if (layer_index != -1)
+  {
+    // Already present.
+    return layout.layerPtr(layer_index);
+  }
+
+  MapLayer *layer = layout.addLayer(default_layer::esdfLayerName());
+
+  const float default_distance = -1.0f;
+  size_t distance_clear_value = 0;
+  memcpy(&distance_clear_value, &default_distance, std::min(sizeof(default_distance), sizeof(distance_clear_value)));
+  const size_t clear_value = 0u;
+  layer->voxelLayout().addMember("distance", DataType::kFloat, distance_clear_value);
+  layer->voxelLayout().addMember("obstacle_x", DataType::kInt32, clear_value);
+  layer->voxelLayout().addMember("obstacle_y", DataType::kInt32, clear_value);
+  layer->voxelLayout().addMember("obstacle_z", DataType::kInt32, clear_value);
+
+  if (layer->voxelByteSize() != sizeof(VoxelEsdf))
+  {
+    throw std::runtime_error("VoxelEsdf layer size mismatch");
+  }
+
+  return layer;
+}
+
+MapLayer *addOccupancyMask(MapLayout &layout)
+{
+  int layer_index = layout.layerIndex(default_layer::occupancyMaskLayerName());
+  if (layer_index != -1)
+  {
+    // Already present.
+    return layout.layerPtr(layer_index);
+  }
+
+  // One bit per occupancy voxel: each mask voxel covers 2x2x2 occupancy voxels.
+  MapLayer *layer = layout.addLayer(default_layer::occupancyMaskLayerName(), 1);
+  layer->voxelLayout().addMember("mask", DataType::kUInt8, 0u);
+
+  if (layer->voxelByteSize() != sizeof(uint8_t))
+  {
+    throw std::runtime_error("Occupancy mask layer size mismatch");
+  }
+
+  return layer;
+}
+
+
+MapLayer *addOccupancyState(MapLayout &layout)
+{
+  int layer_index = layout.layerIndex(default_layer::occupancyStateLayerName());
+  if (layer_index != -1)
+  {
+    // Already present.
+    return layout.layerPtr(layer_index);
+  }
+
+  // Two bits per occupancy voxel: each state voxel covers 2x2x2 occupancy voxels. Zero is unobserved.
+  MapLayer *layer = layout.addLayer(default_layer::occupancyStateLayerName(), 1);
+  layer->voxelLayout().addMember("state", DataType::kUInt16, 0u);
+
+  if (layer->voxelByteSize() != sizeof(uint16_t))
+  {
+    throw std::runtime_error("Occupancy state layer size mismatch");
+  }
+
+  return layer;
+}
+
+
+MapLayer *addOccupancyGroup(MapLayout &layout)
+{
+  int layer_index = layout.layerIndex(default_layer::occupancyGroupLayerName());
+  if (layer_index != -1)
+  {
+    // Already present.
+    return layout.layerPtr(layer_index);
+  }
+
+  if (layout.occupancyLayer() == -1)
+  {
+    return nullptr;
+  }
+
+  if (layout.meanLayer() != -1 && layout.traversalLayer() != -1)
+  {
+    return layout.addLayerGroup(default_layer::occupancyGroupLayerName(),
+                                { default_layer::occupancyLayerName(), default_layer::meanLayerName(),
+                                  default_layer::traversalLayerName() });
+  }
+
+  if (layout.meanLayer() != -1)
+  {
+    return layout.addLayerGroup(default_layer::occupancyGroupLayerName(),
+                                { default_layer::occupancyLayerName(), default_layer::meanLayerName() });
+  }
+
+  if (layout.traversalLayer() != -1)
+  {
+    return layout.addLayerGroup(default_layer::occupancyGroupLayerName(),
+                                { default_layer::occupancyLayerName(), default_layer::traversalLayerName() });
+  }
+
+  return nullptr;
+}
 }  // namespace ohm
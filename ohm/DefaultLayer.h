@@ -27,6 +27,9 @@ const char ohm_API *covarianceLayerName();
 /// Name of the voxel clearance layer.
 /// @return "clearance"
 const char ohm_API *clearanceLayerName();
+/// Name of the @c VoxelClearanceChannels layer containing directional clearance values.
+/// @return "clearance_channels"
+const char ohm_API *clearanceChannelsLayerName();
 /// Name of the voxel intensity layer.
 /// @return "intensity"
 const char ohm_API *intensityLayerName();
@@ -39,12 +42,27 @@ const char ohm_API *touchTimeLayerName();
 /// Name of the voxel incident layer.
 /// @return "incident_normal"
 const char ohm_API *incidentNormalLayerName();
+/// Name of the packed voxel touch time and incident normal layer.
+/// @return "touch_incident"
+const char ohm_API *touchIncidentLayerName();
 /// Name of the TSDF voxel layer.
 /// @return "tsdf"
 const char ohm_API *tsdfLayerName();
 /// Name of the layer relating to information on secondary samples (lidar dual returns) falling in a voxel.
 /// @return "secondary_samples"
 const char ohm_API *secondarySamplesLayerName();
+/// Name of the @c VoxelEsdf layer containing Euclidean distances to the nearest obstacles.
+/// @return "esdf"
+const char ohm_API *esdfLayerName();
+/// Name of the occupancy bitmask layer generated by @c thresholdOccupancy() .
+/// @return "occupancy_mask"
+const char ohm_API *occupancyMaskLayerName();
+/// Name of the 2-bit per voxel occupancy state layer.
+/// @return "occupancy_state"
+const char ohm_API *occupancyStateLayerName();
+/// Name of the layer group interleaving the occupancy layer with the voxel mean and traversal layers.
+/// @return "occupancy_group"
+const char ohm_API *occupancyGroupLayerName();
 }  // namespace default_layer
 
 class MapLayout;
@@ -102,6 +120,17 @@ MapLayer ohm_API *addCovariance(MapLayout &layout);
 /// @return The map layer added or the pre-existing layer named according to @c clearanceLayerName() .
 MapLayer ohm_API *addClearance(MapLayout &layout);
 
+/// Add the @c VoxelClearanceChannels layer to @p layout.
+///
+/// Similar to @c addVoxelMean(), this function adds a @c VoxelClearanceChannels layer using the
+/// @c clearanceChannelsLayerName() . The layer holds horizontal and overhead clearance values, maintained by the
+/// @c ClearanceProcess when using @c ClearanceProcess::kQfClearanceChannels . Voxels are initialised with negative
+/// values, marking no known obstruction.
+///
+/// @param layout The @p MapLayout to modify.
+/// @return The map layer added or the pre-existing layer named according to @c clearanceChannelsLayerName() .
+MapLayer ohm_API *addClearanceChannels(MapLayout &layout);
+
 /// Add the voxel intensity (mean and covariance) layer to @p layout.
 ///
 /// Similar to @c addVoxelMean(), this function adds voxel intensity (mean and covariance) using the
@@ -146,6 +175,18 @@ MapLayer ohm_API *addTouchTime(MapLayout &layout);
 /// @return The map layer added or the pre-existing layer named according to @c incidentNormalLayerName() .
 MapLayer ohm_API *addIncidentNormal(MapLayout &layout);
 
+/// Add the packed voxel touch time and incident normal layer to @p layout.
+///
+/// Similar to @c addVoxelMean(), this function adds a @c VoxelTouchIncident layer using the
+/// @c touchIncidentLayerName() . The layer holds the same data as the @c addTouchTime() and @c addIncidentNormal()
+/// layers, but interleaved per voxel so a sample update reads and writes both in a single access.
+///
+/// Currently only maintained by the @c RayMapperOccupancy .
+///
+/// @param layout The @p MapLayout to modify.
+/// @return The map layer added or the pre-existing layer named according to @c touchIncidentLayerName() .
+MapLayer ohm_API *addTouchIncident(MapLayout &layout);
+
 /// Add the truncated signed distance fields voxel layer to @p layout.
 ///
 /// Similar to @c addVoxelMean(), this function adds a @c VoxelTsdf layer using the @c tsdfNormalLayerName() .
@@ -162,6 +203,49 @@ MapLayer ohm_API *addTsdf(MapLayout &layout);
 /// @param layout The @p MapLayout to modify.
 /// @return The map layer added or the pre-existing layer named according to @c secondarySamplesLayerName() .
 MapLayer ohm_API *addSecondarySamples(MapLayout &layout);
+
+/// Add the Euclidean signed distance field voxel layer to @p layout.
+///
+/// Similar to @c addVoxelMean(), this function adds a @c VoxelEsdf layer using the @c esdfLayerName() . The layer is
+/// maintained by an @c EsdfProcess . Voxels are initialised with a negative distance, marking no known obstacle.
+///
+/// @param layout The @p MapLayout to modify.
+/// @return The map layer added or the pre-existing layer named according to @c esdfLayerName() .
+MapLayer ohm_API *addEsdf(MapLayout &layout);
+
+/// Add the occupancy bitmask layer to @p layout.
+///
+/// The layer uses the @c occupancyMaskLayerName() and is subsampled once, so each @c uint8_t voxel holds one bit for
+/// each voxel of the corresponding 2x2x2 block of occupancy voxels - see @c occupancyMaskBit() . The layer is written
+/// by @c thresholdOccupancy() .
+///
+/// @param layout The @p MapLayout to modify.
+/// @return The map layer added or the pre-existing layer named according to @c occupancyMaskLayerName() .
+MapLayer ohm_API *addOccupancyMask(MapLayout &layout);
+
+/// Add the occupancy state layer to @p layout.
+///
+/// The layer uses the @c occupancyStateLayerName() and is subsampled once, so each @c uint16_t voxel holds a 2-bit
+/// @c OccupancyState for each voxel of the corresponding 2x2x2 block of occupancy voxels - see
+/// @c occupancyStateShift() . The layer is maintained by the @c RayMapperOccupancy and may be rebuilt using
+/// @c updateOccupancyState() .
+///
+/// @param layout The @p MapLayout to modify.
+/// @return The map layer added or the pre-existing layer named according to @c occupancyStateLayerName() .
+MapLayer ohm_API *addOccupancyState(MapLayout &layout);
+
+/// Interleave the occupancy layer with the voxel mean and traversal layers, where present, in a layer group named
+/// @c occupancyGroupLayerName() . See @c MapLayout::addLayerGroup() .
+///
+/// The occupancy, mean and traversal voxels are read and written together for each sample, so interleaving them
+/// shares cache lines between the layers.
+///
+/// The function makes no changes if @p layout already has a layer named according to @c occupancyGroupLayerName() .
+///
+/// @param layout The @p MapLayout to modify.
+/// @return The group layer, the pre-existing group layer or null if there is no occupancy layer or no other layers to
+///   group with it.
+MapLayer ohm_API *addOccupancyGroup(MapLayout &layout);
 }  // namespace ohm
 
 #endif  // OHMDEFAULTLAYER_H
@@ -0,0 +1,163 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "DynamicPointFilter.h"
+
+#include "MapLayout.h"
+#include "MapProbability.h"
+#include "OccupancyMap.h"
+#include "TaskArena.h"
+#include "VoxelData.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+namespace ohm
+{
+namespace
+{
+/// Check if @p voxel is observed with an occupancy value at or below @p free_value .
+inline bool confidentlyFree(const Voxel<const float> &voxel, float free_value)
+{
+  if (!voxel.isValid())
+  {
+    return false;
+  }
+  float occupancy = unobservedOccupancyValue();
+  voxel.read(&occupancy);
+  return occupancy != unobservedOccupancyValue() && occupancy <= free_value;
+}
+
+
+/// Check if the sample voxel @p key - and optionally its face neighbours - is confidently free.
+bool dynamicSample(const OccupancyMap &map, Voxel<const float> &voxel, const Key &key, float free_value,
+                   bool check_neighbours)
+{
+  voxel.setKey(key);
+  if (!confidentlyFree(voxel, free_value))
+  {
+    return false;
+  }
+
+  if (check_neighbours)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      for (int dir = -1; dir <= 1; dir += 2)
+      {
+        Key neighbour = key;
+        map.stepKey(neighbour, axis, dir);
+        voxel.setKey(neighbour);
+        if (!confidentlyFree(voxel, free_value))
+        {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+}  // namespace
+
+
+DynamicPointFilter::DynamicPointFilter(const OccupancyMap &map, const DynamicPointFilterParams &params)
+  : map_(&map)
+  , params_(params)
+{}
+
+
+bool DynamicPointFilter::isDynamic(const glm::dvec3 &sample) const
+{
+  const int occupancy_layer = map_->layout().occupancyLayer();
+  if (occupancy_layer < 0)
+  {
+    return false;
+  }
+
+  Voxel<const float> voxel(map_, occupancy_layer);
+  const float free_value = probabilityToValue(float(params_.free_probability));
+  return dynamicSample(*map_, voxel, map_->voxelKey(sample), free_value, params_.check_neighbours);
+}
+
+
+void DynamicPointFilter::filter(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count)
+{
+  dynamic_rays_.clear();
+  const int occupancy_layer = map_->layout().occupancyLayer();
+  if (occupancy_layer < 0 || ray_count == 0)
+  {
+    return;
+  }
+
+  const float free_value = probabilityToValue(float(params_.free_probability));
+  const bool check_neighbours = params_.check_neighbours;
+  dynamic_flags_.resize(ray_count);
+  const auto check_rays = [&](size_t begin, size_t end) {
+    Voxel<const float> voxel(map_, occupancy_layer);
+    for (size_t i = begin; i < end; ++i)
+    {
+      const bool check = (filter_flags[i] & (kRffInvalid | kRffClippedEnd)) == 0;
+      const glm::dvec3 &sample = rays[i * 2 + 1];
+      dynamic_flags_[i] =
+        uint8_t(check && dynamicSample(*map_, voxel, map_->voxelKey(sample), free_value, check_neighbours));
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (params_.use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, ray_count),
+                        [&check_rays](const tbb::blocked_range<size_t> &range) {
+                          check_rays(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    check_rays(0, ray_count);
+  }
+
+  const unsigned action_flag = (params_.action == DynamicPointAction::kCullRay) ? kRffInvalid : kRffClippedEnd;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    total_checked_count_ += (filter_flags[i] & (kRffInvalid | kRffClippedEnd)) == 0;
+    if (dynamic_flags_[i])
+    {
+      filter_flags[i] |= action_flag;
+      dynamic_rays_.emplace_back(i);
+    }
+  }
+  total_dynamic_count_ += dynamic_rays_.size();
+}
+
+
+RayBatchFilterFunction DynamicPointFilter::batchFilter(const RayBatchFilterFunction &chain)
+{
+  return [this, chain](glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count) {
+    if (chain)
+    {
+      chain(rays, filter_flags, ray_count);
+    }
+    filter(rays, filter_flags, ray_count);
+  };
+}
+
+
+void DynamicPointFilter::install(OccupancyMap &map)
+{
+  map.setRayBatchFilter(batchFilter(map.rayBatchFilter()));
+}
+
+
+void DynamicPointFilter::resetStatistics()
+{
+  total_dynamic_count_ = total_checked_count_ = 0;
+}
+}  // namespace ohm
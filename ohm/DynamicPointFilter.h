@@ -0,0 +1,125 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_DYNAMICPOINTFILTER_H
+#define OHM_DYNAMICPOINTFILTER_H
+
+#include "OhmConfig.h"
+
+#include "RayFilter.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// How @c DynamicPointFilter treats the rays of dynamic samples.
+enum class DynamicPointAction : int
+{
+  /// Keep the ray as free space evidence, but do not integrate the sample as a hit. Sets @c kRffClippedEnd .
+  kClearSample = 0,
+  /// Cull the ray. Sets @c kRffInvalid .
+  kCullRay = 1
+};
+
+/// Parameters for @c DynamicPointFilter .
+struct ohm_API DynamicPointFilterParams
+{
+  /// Voxels with an occupancy probability at or below this value are confidently free. This should be well below
+  /// the map's occupancy threshold so that a voxel must be observed free several times.
+  double free_probability = 0.12;  // NOLINT(readability-magic-numbers)
+  /// Also require the face neighbours of the sample voxel to be confidently free. This tolerates samples which
+  /// graze static surfaces or fall near voxel boundaries.
+  bool check_neighbours = true;
+  /// What to do with the rays of dynamic samples.
+  DynamicPointAction action = DynamicPointAction::kClearSample;
+  /// Check samples using multiple threads when available.
+  bool use_threads = true;
+};
+
+/// A batch ray filter which flags samples that fall in confidently free space before they are integrated.
+///
+/// Moving objects leave streaks of occupied voxels through space the map has already seen as free. This filter
+/// checks each incoming sample against the current map state and flags samples whose voxel - and optionally its face
+/// neighbours - the map holds as confidently free. The rays of flagged samples are either kept as free space evidence
+/// without a hit, or culled. See @c DynamicPointAction .
+///
+/// The filter is a @c RayBatchFilterFunction stage. It runs once per ray batch ahead of integration, checking the
+/// samples in parallel with TBB when available. Install it on an @c OccupancyMap with @c install() , which chains the
+/// map's existing batch filter, so it is applied by @c RayMapperOccupancy and @c RayMapperTsdf . For a @c GpuMap ,
+/// pass @c batchFilter() to @c GpuMap::setRayBatchFilter() , chaining @c GpuMap::effectiveRayBatchFilter() . The
+/// filter reads the host voxels, so the @c GpuMap must synchronise its voxels periodically for the filter to see
+/// recent updates.
+///
+/// Installed filters reference this object, which must outlive the installation. The filter must not run
+/// concurrently with updates to the map. Samples in unobserved or occupied voxels are never flagged, so the filter
+/// has no effect on a new map until free space has been observed.
+class ohm_API DynamicPointFilter
+{
+public:
+  /// Constructor.
+  /// @param map The map to check samples against. Must outlive this object.
+  /// @param params Filter parameters.
+  explicit DynamicPointFilter(const OccupancyMap &map,
+                              const DynamicPointFilterParams &params = DynamicPointFilterParams());
+
+  /// Access the filter parameters.
+  /// @return The parameters.
+  inline const DynamicPointFilterParams &params() const { return params_; }
+  /// Set the filter parameters.
+  /// @param params The new parameters.
+  inline void setParams(const DynamicPointFilterParams &params) { params_ = params; }
+
+  /// Check if a @p sample falls in confidently free space.
+  /// @param sample The sample point to check.
+  /// @return True if the sample is considered dynamic.
+  bool isDynamic(const glm::dvec3 &sample) const;
+
+  /// Filter a batch of rays. Compatible with @c RayBatchFilterFunction . Rays already marked with @c kRffInvalid or
+  /// @c kRffClippedEnd are not checked.
+  /// @param rays Array of origin/sample point pairs.
+  /// @param filter_flags Array of flags, one per ray.
+  /// @param ray_count The number of rays.
+  void filter(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count);
+
+  /// Create a @c RayBatchFilterFunction which applies @p chain then this filter.
+  /// @param chain Optional filter to apply first, such as the map's existing batch filter.
+  /// @return The combined filter function.
+  RayBatchFilterFunction batchFilter(const RayBatchFilterFunction &chain = RayBatchFilterFunction());
+
+  /// Install this filter as the @c OccupancyMap::rayBatchFilter() of @p map , chaining the existing batch filter.
+  /// @param map The map to install on. Generally the map given on construction.
+  void install(OccupancyMap &map);
+
+  /// Access the indices of the rays flagged in the last @c filter() call.
+  /// @return The flagged ray indices.
+  inline const std::vector<size_t> &dynamicRays() const { return dynamic_rays_; }
+
+  /// Query the number of rays flagged since construction or @c resetStatistics() .
+  /// @return The total flagged ray count.
+  inline size_t totalDynamicCount() const { return total_dynamic_count_; }
+
+  /// Query the number of rays checked since construction or @c resetStatistics() .
+  /// @return The total checked ray count.
+  inline size_t totalCheckedCount() const { return total_checked_count_; }
+
+  /// Reset the @c totalDynamicCount() and @c totalCheckedCount() .
+  void resetStatistics();
+
+private:
+  const OccupancyMap *map_;
+  DynamicPointFilterParams params_;
+  std::vector<uint8_t> dynamic_flags_;
+  std::vector<size_t> dynamic_rays_;
+  size_t total_dynamic_count_ = 0;
+  size_t total_checked_count_ = 0;
+};
+}  // namespace ohm
+
+#endif  // OHM_DYNAMICPOINTFILTER_H
@@ -0,0 +1,591 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "EsdfProcess.h"
+
+#include "DefaultLayer.h"
+#include "Key.h"
+#include "KeyList.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "RegionChangeFeed.h"
+#include "Voxel.h"
+#include "VoxelEsdf.h"
+#include "VoxelOccupancy.h"
+
+#include "private/EsdfProcessDetail.h"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+
+namespace ohm
+{
+namespace
+{
+/// Offsets to the 26 voxel neighbourhood.
+const glm::ivec3 kNeighbourOffsets[] = {
+  { -1, -1, -1 }, { 0, -1, -1 }, { 1, -1, -1 }, { -1, 0, -1 }, { 0, 0, -1 }, { 1, 0, -1 }, { -1, 1, -1 },
+  { 0, 1, -1 },   { 1, 1, -1 },  { -1, -1, 0 }, { 0, -1, 0 },  { 1, -1, 0 }, { -1, 0, 0 }, { 1, 0, 0 },
+  { -1, 1, 0 },   { 0, 1, 0 },   { 1, 1, 0 },   { -1, -1, 1 }, { 0, -1, 1 }, { 1, -1, 1 }, { -1, 0, 1 },
+  { 0, 0, 1 },    { 1, 0, 1 },   { -1, 1, 1 },  { 0, 1, 1 },   { 1, 1, 1 },
+};
+
+/// Number of wavefront items to process between time slice checks.
+constexpr unsigned kTimeCheckInterval = 256;
+
+/// Voxel access helper for the @c EsdfProcess . This references voxels in existing regions only.
+class EsdfContext
+{
+public:
+  EsdfContext(OccupancyMap &map, const EsdfProcessDetail &params)
+    : map_(map)
+    , occupancy_(&map, map.layout().occupancyLayer())
+    , obstacle_occupancy_(static_cast<const OccupancyMap *>(&map), map.layout().occupancyLayer())
+    , esdf_(&map, map.layout().layerIndex(default_layer::esdfLayerName()))
+    , resolution_(float(map.resolution()))
+    , max_distance_(params.max_distance)
+    , unknown_as_occupied_((params.query_flags & kQfUnknownAsOccupied) != 0)
+  {}
+
+  inline OccupancyMap &map() { return map_; }
+  inline float resolution() const { return resolution_; }
+  inline float maxDistance() const { return max_distance_; }
+  inline bool layersValid() const { return occupancy_.isLayerValid() && esdf_.isLayerValid(); }
+
+  /// Reference the voxel at @p key . Fails if the region for @p key does not exist.
+  bool bind(const Key &key)
+  {
+    if (key.regionKey() != region_key_ || !chunk_)
+    {
+      region_key_ = key.regionKey();
+      chunk_ = map_.region(region_key_, false);
+    }
+
+    if (!chunk_)
+    {
+      return false;
+    }
+
+    occupancy_.setKey(key, chunk_);
+    esdf_.setKey(key, chunk_);
+    return true;
+  }
+
+  inline VoxelEsdf esdf() const { return esdf_.data(); }
+  inline void setEsdf(const VoxelEsdf &value) { esdf_.write(value); }
+
+  /// Is the bound voxel an obstacle?
+  inline bool isObstacle() const { return isObstacleValue(occupancy_.data()); }
+
+  /// Is the voxel at @p key an obstacle? Does not modify the bound voxel.
+  bool isObstacle(const Key &key)
+  {
+    obstacle_occupancy_.setKey(key);
+    return obstacle_occupancy_.isValid() && isObstacleValue(obstacle_occupancy_.data());
+  }
+
+  inline bool isObstacleValue(float occupancy) const
+  {
+    return (occupancy != unobservedOccupancyValue()) ? occupancy >= map_.occupancyThresholdValue() :
+                                                       unknown_as_occupied_;
+  }
+
+  inline float distanceForOffset(const glm::ivec3 &offset) const
+  {
+    return glm::length(glm::vec3(offset)) * resolution_;
+  }
+
+private:
+  OccupancyMap &map_;
+  Voxel<const float> occupancy_;
+  Voxel<const float> obstacle_occupancy_;
+  Voxel<VoxelEsdf> esdf_;
+  MapChunk *chunk_ = nullptr;
+  glm::i16vec3 region_key_{ 0 };
+  float resolution_ = 0;
+  float max_distance_ = 0;
+  bool unknown_as_occupied_ = false;
+};
+
+
+/// Make a @c VoxelEsdf value.
+inline VoxelEsdf makeEsdf(float distance, const glm::ivec3 &offset)
+{
+  VoxelEsdf voxel{};
+  voxel.distance = distance;
+  voxel.obstacle_x = int32_t(offset.x);
+  voxel.obstacle_y = int32_t(offset.y);
+  voxel.obstacle_z = int32_t(offset.z);
+  return voxel;
+}
+
+
+/// A @c VoxelEsdf value with no known obstacle.
+inline VoxelEsdf invalidEsdf()
+{
+  return makeEsdf(-1.0f, glm::ivec3(0));
+}
+
+
+/// Push the valid neighbours of @p key onto the lower wavefront.
+void pullNeighbours(EsdfContext &context, EsdfProcessDetail &detail, const Key &key)
+{
+  for (const glm::ivec3 &offset : kNeighbourOffsets)
+  {
+    Key neighbour = key;
+    context.map().moveKey(neighbour, offset);
+    if (context.bind(neighbour))
+    {
+      const VoxelEsdf voxel = context.esdf();
+      if (esdfHasObstacle(voxel))
+      {
+        detail.lower_queue.push(EsdfLowerItem{ voxel.distance, neighbour });
+      }
+    }
+  }
+}
+
+
+/// Convert the pending changes into wavefront items.
+void processChanges(EsdfContext &context, EsdfProcessDetail &detail)
+{
+  for (const Key &key : detail.changed_keys)
+  {
+    if (!context.bind(key))
+    {
+      continue;
+    }
+
+    const VoxelEsdf voxel = context.esdf();
+    const bool obstacle = context.isObstacle();
+    const bool was_obstacle = voxel.distance == 0;
+
+    if (obstacle && !was_obstacle)
+    {
+      // New obstacle: start a lower wavefront.
+      context.setEsdf(makeEsdf(0.0f, glm::ivec3(0)));
+      detail.lower_queue.push(EsdfLowerItem{ 0.0f, key });
+    }
+    else if (!obstacle && was_obstacle)
+    {
+      // Removed obstacle: start a raise wavefront.
+      context.setEsdf(invalidEsdf());
+      detail.raise_queue.emplace_back(key);
+    }
+    else if (!obstacle && !esdfHasObstacle(voxel))
+    {
+      // Newly observed free voxel: grow the field from the neighbours.
+      pullNeighbours(context, detail, key);
+    }
+  }
+  detail.changed_keys.clear();
+}
+
+
+/// Process the raise wavefront, invalidating voxels whose nearest obstacle has been removed. Invalidated voxels are
+/// refilled by pushing their valid neighbours onto the lower wavefront.
+/// @return True if the raise wavefront is complete, false if the time slice expired.
+template <typename TimeCheck>
+bool processRaise(EsdfContext &context, EsdfProcessDetail &detail, TimeCheck &&time_expired)
+{
+  unsigned iterations = 0;
+  while (!detail.raise_queue.empty())
+  {
+    if (++iterations % kTimeCheckInterval == 0 && time_expired())
+    {
+      return false;
+    }
+
+    const Key key = detail.raise_queue.front();
+    detail.raise_queue.pop_front();
+
+    for (const glm::ivec3 &offset : kNeighbourOffsets)
+    {
+      Key neighbour = key;
+      context.map().moveKey(neighbour, offset);
+      if (!context.bind(neighbour))
+      {
+        continue;
+      }
+
+      const VoxelEsdf voxel = context.esdf();
+      if (!esdfHasObstacle(voxel))
+      {
+        continue;
+      }
+
+      Key obstacle_key = neighbour;
+      context.map().moveKey(obstacle_key, esdfObstacleOffset(voxel));
+      if (!context.isObstacle(obstacle_key))
+      {
+        context.setEsdf(invalidEsdf());
+        detail.raise_queue.emplace_back(neighbour);
+      }
+      else
+      {
+        detail.lower_queue.push(EsdfLowerItem{ voxel.distance, neighbour });
+      }
+    }
+  }
+
+  return true;
+}
+
+
+/// Process the lower wavefront, nearest first, propagating each voxel's nearest obstacle to its neighbours where this
+/// reduces the neighbour distance.
+/// @return True if the lower wavefront is complete, false if the time slice expired.
+template <typename TimeCheck>
+bool processLower(EsdfContext &context, EsdfProcessDetail &detail, TimeCheck &&time_expired)
+{
+  unsigned iterations = 0;
+  while (!detail.lower_queue.empty())
+  {
+    if (++iterations % kTimeCheckInterval == 0 && time_expired())
+    {
+      return false;
+    }
+
+    const EsdfLowerItem item = detail.lower_queue.top();
+    detail.lower_queue.pop();
+
+    if (!context.bind(item.key))
+    {
+      continue;
+    }
+
+    const VoxelEsdf voxel = context.esdf();
+    if (!esdfHasObstacle(voxel) || voxel.distance != item.distance)
+    {
+      // Invalidated or superseded since queued.
+      continue;
+    }
+
+    const glm::ivec3 obstacle_offset = esdfObstacleOffset(voxel);
+    for (const glm::ivec3 &offset : kNeighbourOffsets)
+    {
+      const glm::ivec3 neighbour_offset = obstacle_offset - offset;
+      const float distance = context.distanceForOffset(neighbour_offset);
+      if (distance > context.maxDistance())
+      {
+        continue;
+      }
+
+      Key neighbour = item.key;
+      context.map().moveKey(neighbour, offset);
+      if (!context.bind(neighbour))
+      {
+        continue;
+      }
+
+      const VoxelEsdf neighbour_voxel = context.esdf();
+      if (!esdfHasObstacle(neighbour_voxel) || distance < neighbour_voxel.distance)
+      {
+        context.setEsdf(makeEsdf(distance, neighbour_offset));
+        detail.lower_queue.push(EsdfLowerItem{ distance, neighbour });
+      }
+    }
+  }
+
+  return true;
+}
+
+
+/// Process the wavefronts until complete or @p time_slice expires.
+/// @return True if the wavefronts are complete.
+bool propagate(EsdfContext &context, EsdfProcessDetail &detail, double time_slice)
+{
+  using Clock = std::chrono::high_resolution_clock;
+  const auto start_time = Clock::now();
+  const auto time_expired = [start_time, time_slice]() {
+    if (time_slice <= 0)
+    {
+      return false;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time);
+    return elapsed.count() >= time_slice;
+  };
+
+  // The raise wavefront must complete before lowering, otherwise invalid distances may be propagated.
+  return processRaise(context, detail, time_expired) && processLower(context, detail, time_expired);
+}
+}  // namespace
+
+
+void EsdfProcessDetail::bind(OccupancyMap &map)
+{
+  if (this->map == &map && rebase_feed && rebase_feed->isSubscribed())
+  {
+    // Only the rebase callback is of interest. Discard the changed regions to bound the feed.
+    rebase_feed->clear();
+    return;
+  }
+
+  this->map = &map;
+  rebase_feed = std::make_unique<RegionChangeFeed>(map);
+  rebase_feed->setRebaseCallback([this](const glm::dvec3 &region_shift) { rebase(region_shift); });
+}
+
+
+void EsdfProcessDetail::rebase(const glm::dvec3 &region_shift)
+{
+  const auto shift_key = [&region_shift](Key &key) {
+    glm::i16vec3 region_key = key.regionKey();
+    if (!OccupancyMap::shiftRegionKey(region_key, region_shift))
+    {
+      return false;
+    }
+    key.setRegionKey(region_key);
+    return true;
+  };
+
+  size_t keep_count = 0;
+  for (size_t i = 0; i < changed_keys.size(); ++i)
+  {
+    Key key = changed_keys[i];
+    if (shift_key(key))
+    {
+      changed_keys[keep_count++] = key;
+    }
+  }
+  changed_keys.resize(keep_count);
+
+  std::deque<Key> raise;
+  for (Key key : raise_queue)
+  {
+    if (shift_key(key))
+    {
+      raise.emplace_back(key);
+    }
+  }
+  raise_queue.swap(raise);
+
+  // The shift preserves the distance ordering.
+  decltype(lower_queue) lower;
+  while (!lower_queue.empty())
+  {
+    EsdfLowerItem item = lower_queue.top();
+    lower_queue.pop();
+    if (shift_key(item.key))
+    {
+      lower.push(item);
+    }
+  }
+  lower_queue.swap(lower);
+}
+
+
+EsdfProcess::EsdfProcess()
+  : imp_(new EsdfProcessDetail)
+{}
+
+
+EsdfProcess::EsdfProcess(float max_distance, unsigned query_flags)
+  : EsdfProcess()
+{
+  setMaxDistance(max_distance);
+  setQueryFlags(query_flags);
+}
+
+
+EsdfProcess::~EsdfProcess()
+{
+  EsdfProcessDetail *d = imp();
+  delete d;
+  imp_ = nullptr;
+}
+
+
+float EsdfProcess::maxDistance() const
+{
+  return imp()->max_distance;
+}
+
+
+void EsdfProcess::setMaxDistance(float distance)
+{
+  imp()->max_distance = distance;
+}
+
+
+unsigned EsdfProcess::queryFlags() const
+{
+  return imp()->query_flags;
+}
+
+
+void EsdfProcess::setQueryFlags(unsigned flags)
+{
+  imp()->query_flags = flags;
+}
+
+
+KeyList &EsdfProcess::changedKeys()
+{
+  return imp()->changed_keys;
+}
+
+
+void EsdfProcess::addChangedKey(const Key &key)
+{
+  imp()->changed_keys.emplace_back(key);
+}
+
+
+size_t EsdfProcess::pendingCount() const
+{
+  const EsdfProcessDetail *d = imp();
+  return d->changed_keys.size() + d->raise_queue.size() + d->lower_queue.size();
+}
+
+
+void EsdfProcess::reset()
+{
+  EsdfProcessDetail *d = imp();
+  d->changed_keys.clear();
+  d->raise_queue.clear();
+  d->lower_queue = decltype(d->lower_queue)();
+}
+
+
+void EsdfProcess::ensureEsdfLayer(OccupancyMap &map)
+{
+  if (map.layout().layerIndex(default_layer::esdfLayerName()) != -1)
+  {
+    return;
+  }
+
+  // Duplicate the layout, add the layer and update the map, preserving the current map.
+  MapLayout updated_layout(map.layout());
+  addEsdf(updated_layout);
+  map.updateLayout(updated_layout, true);
+}
+
+
+bool EsdfProcess::layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                                    std::vector<int> &write_layers) const
+{
+  const int occupancy_layer = layout.occupancyLayer();
+  const int esdf_layer = layout.layerIndex(default_layer::esdfLayerName());
+  if (occupancy_layer < 0 || esdf_layer < 0)
+  {
+    return false;
+  }
+
+  read_layers.emplace_back(occupancy_layer);
+  write_layers.emplace_back(esdf_layer);
+  return true;
+}
+
+
+void EsdfProcess::prepareUpdate(OccupancyMap &map)
+{
+  ensureEsdfLayer(map);
+  imp()->bind(map);
+}
+
+
+int EsdfProcess::update(OccupancyMap &map, double time_slice)
+{
+  EsdfProcessDetail *d = imp();
+  ensureEsdfLayer(map);
+  d->bind(map);
+
+  EsdfContext context(map, *d);
+  if (!context.layersValid())
+  {
+    reset();
+    return kMprUpToDate;
+  }
+
+  processChanges(context, *d);
+  return (propagate(context, *d, time_slice)) ? kMprUpToDate : kMprProgressing;
+}
+
+
+void EsdfProcess::calculateForExtents(OccupancyMap &map, const glm::dvec3 &min_extents, const glm::dvec3 &max_extents)
+{
+  EsdfProcessDetail *d = imp();
+  ensureEsdfLayer(map);
+  d->bind(map);
+
+  EsdfContext context(map, *d);
+  if (!context.layersValid())
+  {
+    reset();
+    return;
+  }
+
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  const auto visit_regions = [&map](const glm::dvec3 &min_ext, const glm::dvec3 &max_ext, auto &&visit) {
+    const glm::i16vec3 min_region = map.regionKey(min_ext);
+    const glm::i16vec3 max_region = map.regionKey(max_ext);
+    for (int z = min_region.z; z <= max_region.z; ++z)
+    {
+      for (int y = min_region.y; y <= max_region.y; ++y)
+      {
+        for (int x = min_region.x; x <= max_region.x; ++x)
+        {
+          const glm::i16vec3 region_key(x, y, z);
+          if (map.region(region_key, false))
+          {
+            visit(region_key);
+          }
+        }
+      }
+    }
+  };
+  const auto visit_voxels = [&region_dim](const glm::i16vec3 &region_key, auto &&visit) {
+    for (int z = 0; z < region_dim.z; ++z)
+    {
+      for (int y = 0; y < region_dim.y; ++y)
+      {
+        for (int x = 0; x < region_dim.x; ++x)
+        {
+          visit(Key(region_key, x, y, z));
+        }
+      }
+    }
+  };
+
+  // Reset the field within the extents.
+  visit_regions(min_extents, max_extents, [&](const glm::i16vec3 &region_key) {
+    visit_voxels(region_key, [&](const Key &key) {
+      context.bind(key);
+      context.setEsdf(invalidEsdf());
+    });
+  });
+
+  // Seed the obstacles from the padded extents. Obstacles outside the extents may be closer than those inside.
+  const glm::dvec3 padding(context.maxDistance());
+  visit_regions(min_extents - padding, max_extents + padding, [&](const glm::i16vec3 &region_key) {
+    visit_voxels(region_key, [&](const Key &key) {
+      context.bind(key);
+      if (context.isObstacle())
+      {
+        context.setEsdf(makeEsdf(0.0f, glm::ivec3(0)));
+        d->lower_queue.push(EsdfLowerItem{ 0.0f, key });
+      }
+    });
+  });
+
+  processChanges(context, *d);
+  propagate(context, *d, 0);
+}
+
+
+EsdfProcessDetail *EsdfProcess::imp()
+{
+  return imp_;
+}
+
+
+const EsdfProcessDetail *EsdfProcess::imp() const
+{
+  return imp_;
+}
+}  // namespace ohm
@@ -0,0 +1,151 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_ESDFPROCESS_H
+#define OHM_ESDFPROCESS_H
+
+#include "OhmConfig.h"
+
+#include "MappingProcess.h"
+#include "QueryFlag.h"
+
+#include <glm/fwd.hpp>
+
+#include <cstddef>
+
+namespace ohm
+{
+struct EsdfProcessDetail;
+class Key;
+class KeyList;
+class OccupancyMap;
+
+/// A CPU mapping process which incrementally maintains a Euclidean distance field in the @c VoxelEsdf layer.
+///
+/// Unlike the @c ClearanceProcess , which recalculates entire regions, this process only updates voxels affected by
+/// changes in occupancy. Changes are provided as a list of voxel keys whose occupancy type has changed, generally by
+/// binding @c changedKeys() to a @c RayMapperOccupancy via @c RayMapperOccupancy::setChangedKeys() . Each @c update()
+/// then processes the pending changes using raise and lower wavefronts, similar to those used by Voxblox and FIESTA:
+/// - A voxel which becomes an obstacle starts a lower wavefront, reducing the distances of surrounding voxels which
+///   are now closer to the new obstacle.
+/// - A voxel which is no longer an obstacle starts a raise wavefront, invalidating voxels whose nearest obstacle was
+///   removed. The lower wavefront then refills the invalidated voxels from the surrounding valid voxels.
+/// - A voxel which becomes observed pulls distances in from its neighbours. This grows the field into newly
+///   observed space.
+///
+/// Each voxel stores the offset to its nearest obstacle, so distances are calculated between voxel centres and the
+/// update cost scales with the number of voxels whose distance changes rather than the region volume. Propagation uses
+/// a 26 voxel neighbourhood and is limited to the @c maxDistance() . Like other wavefront approaches, the results are
+/// a close approximation of the true Euclidean distance, and never shorter than the distance to a real obstacle.
+///
+/// Obstacles are occupied voxels, or unobserved voxels when the @c kQfUnknownAsOccupied flag is set. Only existing map
+/// regions are updated; the field does not extend into regions which do not exist.
+///
+/// Use @c calculateForExtents() to build the field for an existing map, such as one which has been loaded. The
+/// incremental update assumes the field was previously consistent with the occupancy layer.
+///
+/// The process subscribes to @c OccupancyMap::rebaseOrigin() events from the map passed to the first
+/// @c prepareUpdate() , @c update() or @c calculateForExtents() call. A rebase then re-keys the pending changes and
+/// wavefronts. The field itself stores obstacle offsets relative to each voxel, so it remains valid across a rebase.
+class ohm_API EsdfProcess : public MappingProcess
+{
+public:
+  /// Construct a process using the default parameters: a 2m @c maxDistance() and no query flags.
+  EsdfProcess();
+
+  /// Construct a process using the given parameters.
+  /// @param max_distance The maximum distance to propagate obstacle distances.
+  /// @param query_flags Flags controlling the query behaviour. Only @c kQfUnknownAsOccupied is used.
+  EsdfProcess(float max_distance, unsigned query_flags);
+
+  /// Destructor.
+  ~EsdfProcess() override;
+
+  /// Query the maximum distance to which obstacle distances are propagated.
+  /// @return The maximum obstacle distance.
+  float maxDistance() const;
+
+  /// Set the maximum distance to which obstacle distances are propagated. Modifying this value requires a
+  /// @c calculateForExtents() call to update existing distances.
+  /// @param distance The maximum obstacle distance.
+  void setMaxDistance(float distance);
+
+  /// The @c QueryFlag values applied to the process.
+  /// @return The flag values.
+  unsigned queryFlags() const;
+
+  /// Set the @c QueryFlag values for the process. Modifying this value requires a @c calculateForExtents() call to
+  /// update existing distances.
+  /// @param flags The flag values to set.
+  void setQueryFlags(unsigned flags);
+
+  /// Access the list of voxel keys pending update. Keys may be added directly, or the list may be bound to a
+  /// @c RayMapperOccupancy using @c RayMapperOccupancy::setChangedKeys() . The list is cleared by @c update() .
+  /// @return The pending changes list.
+  KeyList &changedKeys();
+
+  /// Add a voxel key to the pending changes list. The key should identify a voxel whose occupancy type has changed.
+  /// @param key The changed voxel key.
+  void addChangedKey(const Key &key);
+
+  /// Query the number of voxels which are pending an update. This is the number of changes keys, plus the size of the
+  /// internal wavefronts.
+  /// @return The number of pending voxels.
+  size_t pendingCount() const;
+
+  /// Clear the pending changes and wavefronts. Existing distances are not modified.
+  void reset() override;
+
+  /// Ensure the @c VoxelEsdf layer is present in @p map .
+  /// @param map The map to ensure has an ESDF layer.
+  static void ensureEsdfLayer(OccupancyMap &map);
+
+  /// Declares the occupancy layer as read and the ESDF layer as written.
+  /// @param layout The map layout.
+  /// @param[out] read_layers Populated with the occupancy layer index.
+  /// @param[out] write_layers Populated with the ESDF layer index.
+  /// @return True when the layers are present.
+  bool layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                         std::vector<int> &write_layers) const override;
+
+  /// Ensures the ESDF layer is present.
+  /// @param map The map to be updated.
+  void prepareUpdate(OccupancyMap &map) override;
+
+  /// Process the pending changes and propagate the resulting wavefronts.
+  ///
+  /// Processing stops when @p time_slice is exceeded, leaving the remaining wavefronts for the next update. The
+  /// pending changes are always consumed.
+  ///
+  /// @param map The map to process.
+  /// @param time_slice The amount of time available for processing (seconds). Zero or negative for no limit.
+  /// @return See @c MappingProcessResult.
+  int update(OccupancyMap &map, double time_slice) override;
+
+  /// Rebuild the distance field for all regions within the given extents. This blocks until the calculations are
+  /// complete and includes processing any pending changes.
+  ///
+  /// The field is reset for the regions in the extents, then obstacles within the extents, padded by the
+  /// @c maxDistance() , are propagated.
+  ///
+  /// @param map The map to process.
+  /// @param min_extents The minimum extents corner of the region to calculate.
+  /// @param max_extents The maximum extents corner of the region to calculate.
+  void calculateForExtents(OccupancyMap &map, const glm::dvec3 &min_extents, const glm::dvec3 &max_extents);
+
+protected:
+  /// Internal data access
+  /// @return The internal data members.
+  EsdfProcessDetail *imp();
+  /// Internal data access
+  /// @return The internal data members.
+  const EsdfProcessDetail *imp() const;
+
+private:
+  EsdfProcessDetail *imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_ESDFPROCESS_H
@@ -0,0 +1,431 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "FrontierIndex.h"
+
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "MapRegion.h"
+#include "OccupancyMap.h"
+#include "RegionChangeFeed.h"
+#include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrder.h"
+
+#include "private/OccupancyMapDetail.h"
+
+#include <glm/glm.hpp>
+
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ohm
+{
+namespace
+{
+/// Voxel state bits held in the @c FrontierRegion::voxels snapshot.
+enum FrontierVoxelBits : uint8_t
+{
+  kStateUnobserved = 0u,
+  kStateFree = 1u,
+  kStateOccupied = 2u,
+  kStateMask = 3u,
+  kFrontierFlag = 4u
+};
+
+/// Index data for a single region.
+struct FrontierRegion
+{
+  /// Occupancy state snapshot per voxel in row major order, combined with the @c kFrontierFlag .
+  std::vector<uint8_t> voxels;
+  /// Number of voxels with the @c kFrontierFlag .
+  size_t frontier_count = 0;
+};
+
+/// Offset @p key by @p offset voxels where each element of @p offset is in [-1, 1].
+Key offsetKey(Key key, const glm::ivec3 &offset, const glm::ivec3 &region_dim)
+{
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (offset[axis])
+    {
+      OccupancyMap::stepKey(key, axis, offset[axis], region_dim);
+    }
+  }
+  return key;
+}
+}  // namespace
+
+struct FrontierIndexDetail
+{
+  OccupancyMap *map = nullptr;
+  std::unique_ptr<RegionChangeFeed> feed;
+  std::unordered_map<glm::i16vec3, FrontierRegion, MapRegion::Hash> regions;
+  glm::ivec3 region_dim{ 0 };
+  size_t frontier_count = 0;
+  bool indexed = false;
+
+  inline size_t localIndex(const glm::u8vec3 &local) const
+  {
+    return local.x + size_t(region_dim.x) * (local.y + size_t(region_dim.y) * local.z);
+  }
+
+  inline Key indexKey(const glm::i16vec3 &region_key, size_t index) const
+  {
+    const size_t plane = size_t(region_dim.x) * size_t(region_dim.y);
+    return Key(region_key, uint8_t(index % region_dim.x), uint8_t((index % plane) / region_dim.x),
+               uint8_t(index / plane));
+  }
+
+  /// Lookup the snapshot state of @p key .
+  uint8_t state(const Key &key) const;
+  /// Update the snapshot for @p region_key , adding the keys of voxels which change state to @p transitions .
+  void snapshotRegion(const glm::i16vec3 &region_key, std::vector<Key> &transitions);
+  /// Re-evaluate the frontier status of @p key .
+  void evaluate(const Key &key);
+  /// Update the index for the given regions.
+  size_t updateRegions(const std::vector<glm::i16vec3> &region_keys);
+  /// Re-key the snapshot for an @c OccupancyMap::rebaseOrigin() .
+  void rebase(const glm::dvec3 &region_shift);
+};
+
+
+uint8_t FrontierIndexDetail::state(const Key &key) const
+{
+  const auto iter = regions.find(key.regionKey());
+  if (iter == regions.end())
+  {
+    return kStateUnobserved;
+  }
+  return iter->second.voxels[localIndex(key.localKey())] & kStateMask;
+}
+
+
+void FrontierIndexDetail::snapshotRegion(const glm::i16vec3 &region_key, std::vector<Key> &transitions)
+{
+  const MapChunk *chunk = static_cast<const OccupancyMap *>(map)->region(region_key);
+  const int occupancy_layer = map->layout().occupancyLayer();
+  auto region_iter = regions.find(region_key);
+
+  if (!chunk || occupancy_layer < 0)
+  {
+    if (region_iter != regions.end())
+    {
+      // The region has been removed: all its observed voxels become unobserved.
+      const FrontierRegion &region = region_iter->second;
+      for (size_t i = 0; i < region.voxels.size(); ++i)
+      {
+        if (region.voxels[i] & kStateMask)
+        {
+          transitions.emplace_back(indexKey(region_key, i));
+        }
+      }
+      frontier_count -= region.frontier_count;
+      regions.erase(region_iter);
+    }
+    return;
+  }
+
+  if (region_iter == regions.end())
+  {
+    region_iter = regions.emplace(region_key, FrontierRegion()).first;
+    region_iter->second.voxels.resize(size_t(region_dim.x) * size_t(region_dim.y) * size_t(region_dim.z),
+                                      kStateUnobserved);
+  }
+
+  FrontierRegion &region = region_iter->second;
+  VoxelBuffer<const VoxelBlock> occupancy_buffer(chunk->voxel_blocks[occupancy_layer]);
+  const VoxelOrder order = resolveVoxelOrder(voxelOrderFromFlags(map->detail()->flags), region_dim);
+  size_t index = 0;
+  glm::ivec3 local_key;
+  for (local_key.z = 0; local_key.z < region_dim.z; ++local_key.z)
+  {
+    for (local_key.y = 0; local_key.y < region_dim.y; ++local_key.y)
+    {
+      for (local_key.x = 0; local_key.x < region_dim.x; ++local_key.x, ++index)
+      {
+        float occupancy = unobservedOccupancyValue();
+        occupancy_buffer.readVoxel(voxelIndex(glm::u8vec3(local_key), region_dim, order), &occupancy);
+        uint8_t state = kStateUnobserved;
+        switch (occupancyType(occupancy, *map))
+        {
+        case kFree:
+          state = kStateFree;
+          break;
+        case kOccupied:
+          state = kStateOccupied;
+          break;
+        default:
+          break;
+        }
+
+        uint8_t &voxel = region.voxels[index];
+        if ((voxel & kStateMask) != state)
+        {
+          voxel = uint8_t((voxel & ~kStateMask) | state);
+          transitions.emplace_back(Key(region_key, glm::u8vec3(local_key)));
+        }
+      }
+    }
+  }
+}
+
+
+void FrontierIndexDetail::evaluate(const Key &key)
+{
+  const auto iter = regions.find(key.regionKey());
+  if (iter == regions.end())
+  {
+    // Unobserved region.
+    return;
+  }
+
+  FrontierRegion &region = iter->second;
+  uint8_t &voxel = region.voxels[localIndex(key.localKey())];
+  bool frontier = false;
+  if ((voxel & kStateMask) == kStateFree)
+  {
+    for (int axis = 0; axis < 3 && !frontier; ++axis)
+    {
+      for (int dir = -1; dir <= 1 && !frontier; dir += 2)
+      {
+        Key neighbour = key;
+        OccupancyMap::stepKey(neighbour, axis, dir, region_dim);
+        frontier = state(neighbour) == kStateUnobserved;
+      }
+    }
+  }
+
+  if (frontier != ((voxel & kFrontierFlag) != 0))
+  {
+    voxel = uint8_t(voxel ^ kFrontierFlag);
+    if (frontier)
+    {
+      ++region.frontier_count;
+      ++frontier_count;
+    }
+    else
+    {
+      --region.frontier_count;
+      --frontier_count;
+    }
+  }
+}
+
+
+size_t FrontierIndexDetail::updateRegions(const std::vector<glm::i16vec3> &region_keys)
+{
+  // Update all snapshots before evaluating so neighbour states are current across region boundaries.
+  std::vector<Key> transitions;
+  for (const auto &region_key : region_keys)
+  {
+    snapshotRegion(region_key, transitions);
+  }
+
+  // A state change may change the frontier status of the voxel itself and its face neighbours.
+  for (const Key &key : transitions)
+  {
+    evaluate(key);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      for (int dir = -1; dir <= 1; dir += 2)
+      {
+        Key neighbour = key;
+        OccupancyMap::stepKey(neighbour, axis, dir, region_dim);
+        evaluate(neighbour);
+      }
+    }
+  }
+
+  return transitions.size();
+}
+
+
+void FrontierIndexDetail::rebase(const glm::dvec3 &region_shift)
+{
+  std::unordered_map<glm::i16vec3, FrontierRegion, MapRegion::Hash> rebased;
+  rebased.reserve(regions.size());
+  for (auto &entry : regions)
+  {
+    glm::i16vec3 region_key = entry.first;
+    if (!OccupancyMap::shiftRegionKey(region_key, region_shift))
+    {
+      // The neighbours of the removed region may change frontier status. Rebuild on the next update.
+      indexed = false;
+      continue;
+    }
+    rebased.emplace(region_key, std::move(entry.second));
+  }
+  regions.swap(rebased);
+}
+
+
+FrontierIndex::FrontierIndex(OccupancyMap &map)
+  : imp_(std::make_unique<FrontierIndexDetail>())
+{
+  imp_->map = &map;
+  imp_->feed = std::make_unique<RegionChangeFeed>(map);
+  FrontierIndexDetail *imp = imp_.get();
+  imp_->feed->setRebaseCallback([imp](const glm::dvec3 &region_shift) { imp->rebase(region_shift); });
+  imp_->region_dim = glm::ivec3(map.regionVoxelDimensions());
+}
+
+
+FrontierIndex::~FrontierIndex() = default;
+
+
+size_t FrontierIndex::update()
+{
+  if (!imp_->feed->isSubscribed())
+  {
+    return 0;
+  }
+
+  if (!imp_->indexed)
+  {
+    return rebuild();
+  }
+
+  std::vector<glm::i16vec3> changed;
+  imp_->feed->drain(changed);
+  return imp_->updateRegions(changed);
+}
+
+
+size_t FrontierIndex::rebuild()
+{
+  imp_->regions.clear();
+  imp_->frontier_count = 0;
+  if (!imp_->feed->isSubscribed())
+  {
+    return 0;
+  }
+
+  imp_->feed->clear();
+  std::vector<const MapChunk *> chunks;
+  imp_->map->enumerateRegions(chunks);
+  std::vector<glm::i16vec3> region_keys;
+  region_keys.reserve(chunks.size());
+  for (const MapChunk *chunk : chunks)
+  {
+    region_keys.emplace_back(chunk->region.coord);
+  }
+
+  imp_->indexed = true;
+  return imp_->updateRegions(region_keys);
+}
+
+
+size_t FrontierIndex::frontierCount() const
+{
+  return imp_->frontier_count;
+}
+
+
+bool FrontierIndex::isFrontier(const Key &key) const
+{
+  const auto iter = imp_->regions.find(key.regionKey());
+  return iter != imp_->regions.end() &&
+         (iter->second.voxels[imp_->localIndex(key.localKey())] & kFrontierFlag) != 0;
+}
+
+
+void FrontierIndex::forEach(const std::function<void(const Key &)> &func) const
+{
+  for (const auto &entry : imp_->regions)
+  {
+    const FrontierRegion &region = entry.second;
+    for (size_t i = 0, found = 0; i < region.voxels.size() && found < region.frontier_count; ++i)
+    {
+      if (region.voxels[i] & kFrontierFlag)
+      {
+        func(imp_->indexKey(entry.first, i));
+        ++found;
+      }
+    }
+  }
+}
+
+
+size_t FrontierIndex::collect(std::vector<Key> &keys) const
+{
+  const size_t initial_size = keys.size();
+  keys.reserve(initial_size + imp_->frontier_count);
+  forEach([&keys](const Key &key) { keys.emplace_back(key); });
+  return keys.size() - initial_size;
+}
+
+
+size_t FrontierIndex::cluster(std::vector<FrontierCluster> &clusters, size_t min_cluster_size) const
+{
+  const size_t initial_size = clusters.size();
+  std::vector<Key> frontiers;
+  collect(frontiers);
+
+  std::unordered_set<Key> visited;
+  visited.reserve(frontiers.size());
+  std::deque<Key> open;
+  FrontierCluster current;
+  for (const Key &seed : frontiers)
+  {
+    if (!visited.insert(seed).second)
+    {
+      continue;
+    }
+
+    // Flood fill the connected frontier voxels.
+    current.keys.clear();
+    open.emplace_back(seed);
+    while (!open.empty())
+    {
+      const Key key = open.front();
+      open.pop_front();
+      current.keys.emplace_back(key);
+
+      glm::ivec3 offset;
+      for (offset.z = -1; offset.z <= 1; ++offset.z)
+      {
+        for (offset.y = -1; offset.y <= 1; ++offset.y)
+        {
+          for (offset.x = -1; offset.x <= 1; ++offset.x)
+          {
+            const Key neighbour = offsetKey(key, offset, imp_->region_dim);
+            if (isFrontier(neighbour) && visited.insert(neighbour).second)
+            {
+              open.emplace_back(neighbour);
+            }
+          }
+        }
+      }
+    }
+
+    if (current.keys.size() < min_cluster_size)
+    {
+      continue;
+    }
+
+    current.min_extents = current.max_extents = imp_->map->voxelCentreGlobal(current.keys.front());
+    current.centroid = glm::dvec3(0.0);
+    for (const Key &key : current.keys)
+    {
+      const glm::dvec3 centre = imp_->map->voxelCentreGlobal(key);
+      current.centroid += centre;
+      current.min_extents = glm::min(current.min_extents, centre);
+      current.max_extents = glm::max(current.max_extents, centre);
+    }
+    current.centroid /= double(current.keys.size());
+    clusters.emplace_back(current);
+  }
+
+  return clusters.size() - initial_size;
+}
+
+
+size_t FrontierIndex::indexedRegionCount() const
+{
+  return imp_->regions.size();
+}
+}  // namespace ohm
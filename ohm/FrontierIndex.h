@@ -0,0 +1,114 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_FRONTIERINDEX_H
+#define OHM_FRONTIERINDEX_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+
+#include <glm/vec3.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct FrontierIndexDetail;
+
+/// A connected group of frontier voxels reported by @c FrontierIndex::cluster() .
+struct ohm_API FrontierCluster
+{
+  /// The frontier voxels in the cluster.
+  std::vector<Key> keys;
+  /// Mean of the voxel centres.
+  glm::dvec3 centroid{ 0.0 };
+  /// Minimum extents of the voxel centres.
+  glm::dvec3 min_extents{ 0.0 };
+  /// Maximum extents of the voxel centres.
+  glm::dvec3 max_extents{ 0.0 };
+};
+
+/// An index of the frontier voxels of an @c OccupancyMap , maintained incrementally as the map changes.
+///
+/// A frontier voxel is a free voxel with at least one unobserved face neighbour. Voxels in regions which do not exist
+/// are unobserved.
+///
+/// The index subscribes to the map with a @c RegionChangeFeed , so it tracks changes made by any of the
+/// @c RayMapper implementations, the @c GpuMap synchronisation and direct voxel edits without hooks in those code
+/// paths. Each call to @c update() drains the changed regions and compares their voxels against a per voxel
+/// occupancy state snapshot held by the index. Only voxels which change state - and their face neighbours, which may
+/// lie in adjacent regions - have their frontier status re-evaluated. The first @c update() indexes all existing
+/// regions.
+///
+/// The snapshot holds one byte per voxel of each indexed region. The frontier set may be iterated with
+/// @c forEach() or @c collect() and grouped into connected clusters with @c cluster() , each at a cost proportional
+/// to the number of frontier voxels rather than the map size.
+///
+/// An @c OccupancyMap::rebaseOrigin() re-keys the snapshot in place, so the frontier set is preserved without a
+/// rebuild. Keys collected before the rebase are invalidated. The index is rebuilt on the next @c update() if the
+/// rebase removed any regions.
+///
+/// Limitations:
+/// - @c update() must not be called concurrently with map updates.
+/// - Removing regions does not notify the index. Call @c rebuild() after culling regions or changing the
+///   occupancy threshold.
+class ohm_API FrontierIndex
+{
+public:
+  /// Create an index over @p map .
+  /// @param map The map to index. Must outlive this object.
+  explicit FrontierIndex(OccupancyMap &map);
+  /// Destructor.
+  ~FrontierIndex();
+
+  FrontierIndex(const FrontierIndex &) = delete;
+  FrontierIndex &operator=(const FrontierIndex &) = delete;
+
+  /// Update the index for the regions changed since the last update.
+  /// @return The number of voxels which changed occupancy state.
+  size_t update();
+
+  /// Discard the index and re-index the whole map.
+  /// @return The number of observed voxels indexed.
+  size_t rebuild();
+
+  /// Query the number of frontier voxels.
+  /// @return The frontier voxel count.
+  size_t frontierCount() const;
+
+  /// Query whether @p key is a frontier voxel as of the last @c update() .
+  /// @param key The voxel to test.
+  /// @return True if @p key is a frontier voxel.
+  bool isFrontier(const Key &key) const;
+
+  /// Invoke @p func for each frontier voxel. The order is undefined.
+  /// @param func The function to invoke.
+  void forEach(const std::function<void(const Key &)> &func) const;
+
+  /// Collect the frontier voxels.
+  /// @param[out] keys The frontier voxel keys are appended here. Not cleared.
+  /// @return The number of keys added.
+  size_t collect(std::vector<Key> &keys) const;
+
+  /// Group the frontier voxels into clusters of voxels connected by faces, edges or corners.
+  /// @param[out] clusters The clusters are appended here. Not cleared.
+  /// @param min_cluster_size Clusters with fewer voxels are discarded.
+  /// @return The number of clusters added.
+  size_t cluster(std::vector<FrontierCluster> &clusters, size_t min_cluster_size = 1) const;
+
+  /// Query the number of regions held by the index.
+  /// @return The indexed region count.
+  size_t indexedRegionCount() const;
+
+private:
+  std::unique_ptr<FrontierIndexDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_FRONTIERINDEX_H
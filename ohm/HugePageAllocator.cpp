@@ -0,0 +1,244 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "HugePageAllocator.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif  // __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace ohm
+{
+// Out of class definitions for ODR use under C++14.
+constexpr size_t HugePageAllocator::kPageSize;
+constexpr size_t HugePageAllocator::kMinBlockSize;
+constexpr size_t HugePageAllocator::kSlotAlignment;
+
+namespace
+{
+/// A mapped huge page divided into equally sized slots.
+struct HugePage
+{
+  uint8_t *base = nullptr;
+  /// Allocation size served by this page.
+  size_t byte_count = 0;
+  /// Distance between slots: @c byte_count rounded up to the @c HugePageAllocator::kSlotAlignment .
+  size_t slot_stride = 0;
+  /// Indices of the unallocated slots.
+  std::vector<unsigned> free_slots;
+  /// Total number of slots.
+  unsigned slot_count = 0;
+};
+
+
+/// Map a @c HugePageAllocator::kPageSize page aligned to the page size.
+/// @return The page memory or null on failure.
+uint8_t *mapHugePage(HugePageMode mode)
+{
+#ifdef __linux__
+  const size_t page_size = HugePageAllocator::kPageSize;
+  if (mode == HugePageMode::kExplicit)
+  {
+    // Huge TLB mappings are aligned to the huge page size.
+    void *mem = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    return (mem != MAP_FAILED) ? static_cast<uint8_t *>(mem) : nullptr;
+  }
+
+  // Over allocate in order to align the mapping, then trim the excess.
+  void *mem = mmap(nullptr, 2 * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+  {
+    return nullptr;
+  }
+
+  auto *start = static_cast<uint8_t *>(mem);
+  auto *aligned = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(start) + page_size - 1u) &
+                                              ~uintptr_t(page_size - 1u));
+  if (aligned > start)
+  {
+    munmap(start, size_t(aligned - start));
+  }
+  const size_t tail = size_t(start + 2 * page_size - (aligned + page_size));
+  if (tail)
+  {
+    munmap(aligned + page_size, tail);
+  }
+  // Advisory only. The mapping is still usable without transparent huge page support.
+  madvise(aligned, page_size, MADV_HUGEPAGE);
+  return aligned;
+#else   // __linux__
+  (void)mode;
+  return nullptr;
+#endif  // __linux__
+}
+
+
+void unmapHugePage(uint8_t *base)
+{
+#ifdef __linux__
+  munmap(base, HugePageAllocator::kPageSize);
+#else   // __linux__
+  (void)base;
+#endif  // __linux__
+}
+}  // namespace
+
+
+struct HugePageAllocatorDetail
+{
+  /// Mapped pages keyed by base address.
+  std::unordered_map<uintptr_t, std::unique_ptr<HugePage>> pages;
+  /// Pages with free slots, keyed by allocation size.
+  std::unordered_map<size_t, std::vector<HugePage *>> available;
+  HugePageStats stats;
+  /// Mirrors @c stats.page_count so @c deallocate() can skip locking when no pages are mapped.
+  std::atomic<size_t> page_count{ 0 };
+  std::atomic<HugePageMode> mode{ HugePageMode::kDisabled };
+  mutable std::mutex mutex;
+};
+
+
+HugePageAllocator &HugePageAllocator::instance()
+{
+  // Never destroyed so voxel memory may be released during static destruction, such as by the compression thread.
+  static auto *allocator = new HugePageAllocator;
+  return *allocator;
+}
+
+
+HugePageAllocator::HugePageAllocator()
+  : imp_(new HugePageAllocatorDetail)
+{
+  imp_->stats.page_size = kPageSize;
+}
+
+
+HugePageAllocator::~HugePageAllocator()
+{
+  delete imp_;
+}
+
+
+HugePageMode HugePageAllocator::mode() const
+{
+  return imp_->mode;
+}
+
+
+void HugePageAllocator::setMode(HugePageMode mode)
+{
+  imp_->mode = mode;
+}
+
+
+void *HugePageAllocator::allocate(size_t byte_count)
+{
+  const HugePageMode mode = imp_->mode;
+  if (mode == HugePageMode::kDisabled)
+  {
+    return nullptr;
+  }
+
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  if (byte_count < kMinBlockSize || byte_count > kPageSize / 2)
+  {
+    ++imp_->stats.fallback_count;
+    return nullptr;
+  }
+
+  std::vector<HugePage *> &available = imp_->available[byte_count];
+  if (available.empty())
+  {
+    uint8_t *base = mapHugePage(mode);
+    if (!base)
+    {
+      ++imp_->stats.fallback_count;
+      return nullptr;
+    }
+
+    auto page = std::make_unique<HugePage>();
+    page->base = base;
+    page->byte_count = byte_count;
+    page->slot_stride = (byte_count + kSlotAlignment - 1u) & ~(kSlotAlignment - 1u);
+    page->slot_count = unsigned(kPageSize / page->slot_stride);
+    // Allocate from the lowest slot first.
+    page->free_slots.reserve(page->slot_count);
+    for (unsigned i = page->slot_count; i > 0; --i)
+    {
+      page->free_slots.emplace_back(i - 1u);
+    }
+    available.emplace_back(page.get());
+    imp_->pages.emplace(reinterpret_cast<uintptr_t>(base), std::move(page));
+    ++imp_->stats.page_count;
+    imp_->page_count = imp_->stats.page_count;
+  }
+
+  HugePage *page = available.back();
+  const unsigned slot = page->free_slots.back();
+  page->free_slots.pop_back();
+  if (page->free_slots.empty())
+  {
+    available.pop_back();
+  }
+  ++imp_->stats.block_count;
+  imp_->stats.used_bytes += page->slot_stride;
+  return page->base + size_t(slot) * page->slot_stride;
+}
+
+
+bool HugePageAllocator::deallocate(void *ptr, size_t byte_count)
+{
+  // The page records the allocation size.
+  (void)byte_count;
+  if (!ptr || imp_->page_count == 0)
+  {
+    return false;
+  }
+
+  const uintptr_t base_address = reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(kPageSize - 1u);
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  const auto page_iter = imp_->pages.find(base_address);
+  if (page_iter == imp_->pages.end())
+  {
+    return false;
+  }
+
+  HugePage *page = page_iter->second.get();
+  const auto slot = unsigned(size_t(static_cast<uint8_t *>(ptr) - page->base) / page->slot_stride);
+  if (page->free_slots.empty())
+  {
+    // Was full. Make available again.
+    imp_->available[page->byte_count].emplace_back(page);
+  }
+  page->free_slots.emplace_back(slot);
+  --imp_->stats.block_count;
+  imp_->stats.used_bytes -= page->slot_stride;
+
+  if (page->free_slots.size() == page->slot_count)
+  {
+    // Empty: release the page.
+    std::vector<HugePage *> &available = imp_->available[page->byte_count];
+    available.erase(std::remove(available.begin(), available.end(), page), available.end());
+    unmapHugePage(page->base);
+    imp_->pages.erase(page_iter);
+    --imp_->stats.page_count;
+    imp_->page_count = imp_->stats.page_count;
+  }
+  return true;
+}
+
+
+HugePageStats HugePageAllocator::stats() const
+{
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  return imp_->stats;
+}
+}  // namespace ohm
@@ -0,0 +1,175 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_HUGEPAGEALLOCATOR_H
+#define OHM_HUGEPAGEALLOCATOR_H
+
+#include "OhmConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace ohm
+{
+struct HugePageAllocatorDetail;
+
+/// Huge page backing options for voxel memory. See @c HugePageAllocator .
+enum class HugePageMode : int
+{
+  /// Voxel memory uses the standard allocator.
+  kDisabled = 0,
+  /// Voxel memory is packed into 2 MiB aligned mappings advised for transparent huge pages (`MADV_HUGEPAGE`).
+  kTransparent,
+  /// Voxel memory is packed into explicit huge pages (`MAP_HUGETLB`). Requires huge pages be reserved with the
+  /// operating system, otherwise allocations fall back to the standard allocator.
+  kExplicit
+};
+
+/// Usage statistics for the @c HugePageAllocator .
+struct ohm_API HugePageStats
+{
+  /// The huge page size (bytes).
+  size_t page_size = 0;
+  /// Number of huge pages currently mapped.
+  size_t page_count = 0;
+  /// Number of voxel buffers currently allocated from huge pages.
+  size_t block_count = 0;
+  /// Bytes currently allocated to voxel buffers from huge pages, including alignment padding.
+  size_t used_bytes = 0;
+  /// Number of allocations which fell back to the standard allocator while huge pages were enabled because the size
+  /// was unsuitable or the pages could not be mapped.
+  size_t fallback_count = 0;
+
+  /// Query the fraction of the mapped huge page memory allocated to voxel buffers.
+  /// @return The page utilisation [0, 1]. Zero when no pages are mapped.
+  inline double utilisation() const
+  {
+    return (page_count) ? double(used_bytes) / double(page_count * page_size) : 0.0;
+  }
+};
+
+/// A process wide allocator which packs @c VoxelBlock memory into 2 MiB huge pages to reduce TLB misses.
+///
+/// Voxel layer memory is allocated in a few fixed sizes, so each huge page is divided into equally sized slots for a
+/// single allocation size. A page is unmapped once all its slots are freed. Allocations smaller than
+/// @c kMinBlockSize or larger than half a page use the standard allocator, as do all allocations when the @c mode()
+/// is @c HugePageMode::kDisabled (default) or on platforms other than Linux.
+///
+/// This sits beneath the @c VoxelMemoryPool : the pool recycles buffers between regions while this allocator
+/// determines the pages backing those buffers. Voxel memory is allocated via @c VoxelByteAllocator which may free
+/// memory from either source, so the @c mode() may be changed at any time. Changes affect subsequent allocations.
+class ohm_API HugePageAllocator
+{
+public:
+  /// The huge page size.
+  static constexpr size_t kPageSize = size_t(2u) * 1024u * 1024u;
+  /// Allocations smaller than this use the standard allocator.
+  static constexpr size_t kMinBlockSize = size_t(16u) * 1024u;
+  /// Slot alignment within a huge page.
+  static constexpr size_t kSlotAlignment = 64u;
+
+  /// Access the process wide allocator.
+  /// @return The allocator instance.
+  static HugePageAllocator &instance();
+
+  HugePageAllocator(const HugePageAllocator &) = delete;
+  HugePageAllocator &operator=(const HugePageAllocator &) = delete;
+
+  /// Query the huge page mode for new allocations.
+  /// @return The current mode.
+  HugePageMode mode() const;
+  /// Set the huge page mode for new allocations. Existing allocations are unaffected.
+  /// @param mode The new mode.
+  void setMode(HugePageMode mode);
+
+  /// Allocate @p byte_count bytes from a huge page.
+  /// @param byte_count The number of bytes required.
+  /// @return The allocated memory or null if the allocation should use the standard allocator.
+  void *allocate(size_t byte_count);
+
+  /// Release memory allocated by @c allocate() .
+  /// @param ptr The memory to release.
+  /// @param byte_count The size of the allocation.
+  /// @return True if @p ptr belongs to a huge page and has been released, false if @p ptr was not allocated by this
+  ///   object.
+  bool deallocate(void *ptr, size_t byte_count);
+
+  /// Query the allocator statistics.
+  /// @return The current statistics.
+  HugePageStats stats() const;
+
+private:
+  HugePageAllocator();
+  ~HugePageAllocator();
+
+  HugePageAllocatorDetail *imp_;
+};
+
+/// A stateless allocator for voxel memory, allocating from the @c HugePageAllocator when enabled and the standard
+/// allocator otherwise.
+/// @tparam T The value type.
+template <typename T>
+class VoxelByteAllocator
+{
+public:
+  /// Value type.
+  using value_type = T;
+
+  VoxelByteAllocator() = default;
+  /// Rebinding constructor.
+  template <typename U>
+  VoxelByteAllocator(const VoxelByteAllocator<U> & /*other*/) noexcept  // NOLINT(google-explicit-constructor)
+  {}
+
+  /// Allocate memory for @p count items.
+  /// @param count The number of items.
+  /// @return The allocated memory.
+  T *allocate(size_t count)
+  {
+    const size_t byte_count = count * sizeof(T);
+    if (byte_count >= HugePageAllocator::kMinBlockSize)
+    {
+      if (void *mem = HugePageAllocator::instance().allocate(byte_count))
+      {
+        return static_cast<T *>(mem);
+      }
+    }
+    return static_cast<T *>(::operator new(byte_count));
+  }
+
+  /// Release memory from @c allocate() .
+  /// @param ptr The memory to release.
+  /// @param count The number of items allocated.
+  void deallocate(T *ptr, size_t count) noexcept
+  {
+    const size_t byte_count = count * sizeof(T);
+    if (byte_count < HugePageAllocator::kMinBlockSize || !HugePageAllocator::instance().deallocate(ptr, byte_count))
+    {
+      ::operator delete(ptr);
+    }
+  }
+};
+
+/// Equality operator. Stateless allocators are always equal.
+template <typename T, typename U>
+inline bool operator==(const VoxelByteAllocator<T> & /*a*/, const VoxelByteAllocator<U> & /*b*/)
+{
+  return true;
+}
+
+/// Inequality operator. Stateless allocators are always equal.
+template <typename T, typename U>
+inline bool operator!=(const VoxelByteAllocator<T> & /*a*/, const VoxelByteAllocator<U> & /*b*/)
+{
+  return false;
+}
+
+/// Byte buffer type used to hold @c VoxelBlock memory.
+using VoxelBytes = std::vector<uint8_t, VoxelByteAllocator<uint8_t>>;
+}  // namespace ohm
+
+#endif  // OHM_HUGEPAGEALLOCATOR_H
@@ -4,16 +4,109 @@
 //
 #include "KeyList.h"
 
+#include "KeyPacker.h"
+
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstring>
 
 namespace ohm
 {
+namespace
+{
+/// Lists shorter than this are sorted by comparison rather than radix sorted.
+const size_t kRadixSortThreshold = 64u;
+
+/// Sort @p values using an LSD radix sort of 8-bit digits, considering only the low @p bits of each value.
+/// @param values The values to sort.
+/// @param scratch Working memory.
+/// @param bits The number of significant bits in @p values .
+void radixSort(std::vector<uint64_t> &values, std::vector<uint64_t> &scratch, unsigned bits)
+{
+  const unsigned kDigitBits = 8u;
+  const size_t kBucketCount = size_t(1) << kDigitBits;
+  scratch.resize(values.size());
+  for (unsigned shift = 0; shift < bits; shift += kDigitBits)
+  {
+    std::array<size_t, kBucketCount> offsets{};
+    for (const uint64_t value : values)
+    {
+      ++offsets[(value >> shift) & (kBucketCount - 1u)];
+    }
+
+    // Skip the pass when all values share the digit, as is common for the region bits.
+    if (offsets[(values.front() >> shift) & (kBucketCount - 1u)] == values.size())
+    {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (size_t &bucket_offset : offsets)
+    {
+      const size_t count = bucket_offset;
+      bucket_offset = offset;
+      offset += count;
+    }
+
+    for (const uint64_t value : values)
+    {
+      scratch[offsets[(value >> shift) & (kBucketCount - 1u)]++] = value;
+    }
+    values.swap(scratch);
+  }
+}
+
+
+/// Sort @p keys for @c KeyList::sort() , optionally removing duplicates.
+/// @return The number of keys remaining.
+size_t sortKeys(std::vector<Key> &keys, const glm::u8vec3 &region_dim, bool unique)
+{
+  const KeyPacker packer(region_dim);
+  if (!packer.isValid())
+  {
+    std::sort(keys.begin(), keys.end());
+    if (unique)
+    {
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    return keys.size();
+  }
+
+  std::vector<uint64_t> packed(keys.size());
+  memorytrack::BufferTracker packed_track(MemorySubsystem::kKeyList);
+  packed_track.track(packed);
+  std::transform(keys.begin(), keys.end(), packed.begin(), [&packer](const Key &key) { return packer.pack(key); });
+  if (packed.size() < kRadixSortThreshold)
+  {
+    std::sort(packed.begin(), packed.end());
+  }
+  else
+  {
+    std::vector<uint64_t> scratch;
+    radixSort(packed, scratch, packer.localBits() + KeyPacker::kRegionBits);
+    memorytrack::BufferTracker scratch_track(MemorySubsystem::kKeyList);
+    scratch_track.track(scratch);
+  }
+
+  if (unique)
+  {
+    packed.erase(std::unique(packed.begin(), packed.end()), packed.end());
+  }
+
+  keys.resize(packed.size());
+  std::transform(packed.begin(), packed.end(), keys.begin(),
+                 [&packer](uint64_t value) { return packer.unpack(value); });
+  return keys.size();
+}
+}  // namespace
+
 KeyList::KeyList(size_t initial_count)
 {
   if (initial_count)
   {
     keys_.resize(initial_count);
+    keys_track_.track(keys_);
   }
 }
 
@@ -24,24 +117,68 @@ KeyList::~KeyList() = default;
 void KeyList::reserve(size_t capacity)
 {
   keys_.reserve(capacity);
+  keys_track_.track(keys_);
 }
 
 
 void KeyList::resize(size_t count)
 {
   keys_.resize(count);
+  keys_track_.track(keys_);
 }
 
 
 void KeyList::emplace_back(const Key &key)  // NOLINT
 {
   keys_.emplace_back(key);
+  keys_track_.track(keys_);
 }
 
 
 Key &KeyList::add()
 {
   keys_.emplace_back(Key::kNull);
+  keys_track_.track(keys_);
   return keys_.back();
 }
+
+
+void KeyList::append(const KeyList &other)
+{
+  keys_.insert(keys_.end(), other.keys_.begin(), other.keys_.end());
+  keys_track_.track(keys_);
+}
+
+
+void KeyList::sort(const glm::u8vec3 &region_dim)
+{
+  sortKeys(keys_, region_dim, false);
+  keys_track_.track(keys_);
+}
+
+
+size_t KeyList::sortUnique(const glm::u8vec3 &region_dim)
+{
+  const size_t count = sortKeys(keys_, region_dim, true);
+  keys_track_.track(keys_);
+  return count;
+}
+
+
+size_t KeyList::regionRanges(std::vector<RegionRange> *ranges) const
+{
+  ranges->clear();
+  for (size_t i = 0; i < keys_.size(); ++i)
+  {
+    if (ranges->empty() || ranges->back().region_key != keys_[i].regionKey())
+    {
+      ranges->emplace_back(RegionRange{ keys_[i].regionKey(), i, i + 1 });
+    }
+    else
+    {
+      ranges->back().end = i + 1;
+    }
+  }
+  return ranges->size();
+}
 }  // namespace ohm
@@ -8,6 +8,9 @@
 #include "OhmConfig.h"
 
 #include "Key.h"
+#include "MemoryTrack.h"
+
+#include <glm/vec3.hpp>
 
 #include <vector>
 
@@ -248,8 +251,45 @@ public:
   /// @param key The key to add.
   inline void add(const Key &key) { return emplace_back(key); }
 
+  /// Append all keys from @p other .
+  /// @param other The keys to add.
+  void append(const KeyList &other);
+
+  /// A contiguous range of keys from the same region - see @c regionRanges() .
+  struct RegionRange
+  {
+    /// The region key shared by the keys in the range.
+    glm::i16vec3 region_key;
+    /// Index of the first key in the range.
+    size_t begin;
+    /// Index one past the last key in the range.
+    size_t end;
+  };
+
+  /// Sort the keys so that the keys of each region are contiguous, ordered by region then by local key.
+  ///
+  /// Keys are packed into 64-bit integers and radix sorted when supported by @p region_dim . Otherwise the keys are
+  /// sorted by comparison, which yields a different, but still region grouped, order. See @c KeyPacker .
+  ///
+  /// @param region_dim The region voxel dimensions of the map the keys belong to.
+  void sort(const glm::u8vec3 &region_dim);
+
+  /// Sort the keys as for @c sort() and remove duplicate keys. This is generally faster than deduplicating keys via
+  /// a hash set.
+  /// @param region_dim The region voxel dimensions of the map the keys belong to.
+  /// @return The number of unique keys.
+  size_t sortUnique(const glm::u8vec3 &region_dim);
+
+  /// Collect the ranges of consecutive keys which share the same region. Note this only yields a single range per
+  /// region after the list has been sorted - see @c sort() .
+  /// @param[out] ranges Populated with the region ranges. Cleared before use.
+  /// @return The number of ranges.
+  size_t regionRanges(std::vector<RegionRange> *ranges) const;
+
 private:
   std::vector<Key> keys_;
+  /// Tracks the @c keys_ capacity for @c MemorySubsystem::kKeyList .
+  memorytrack::BufferTracker keys_track_{ MemorySubsystem::kKeyList };
 };
 }  // namespace ohm
 
@@ -0,0 +1,30 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "KeyPacker.h"
+
+namespace ohm
+{
+namespace
+{
+/// Calculate the number of bits required to represent local key values [0, @p dim ).
+unsigned bitsFor(unsigned dim)
+{
+  unsigned bits = 0;
+  while (dim > 1u && (1u << bits) < dim)
+  {
+    ++bits;
+  }
+  return bits;
+}
+}  // namespace
+
+KeyPacker::KeyPacker(const glm::u8vec3 &region_dim)
+{
+  local_bits_ = glm::u8vec3(bitsFor(region_dim.x), bitsFor(region_dim.y), bitsFor(region_dim.z));
+  local_shift_ = glm::u8vec3(0, local_bits_.x, local_bits_.x + local_bits_.y);
+  valid_ = region_dim.x && region_dim.y && region_dim.z && localBits() + kRegionBits <= 64u;
+}
+}  // namespace ohm
@@ -0,0 +1,86 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_KEYPACKER_H
+#define OHM_KEYPACKER_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+
+#include <glm/vec3.hpp>
+
+#include <cinttypes>
+
+namespace ohm
+{
+/// Converts between a @c Key and a packed, 64-bit integer form for maps with a given region voxel dimensions.
+///
+/// A packed key is a compact, single integer identifier for a voxel suited to fast hashing, comparison and radix
+/// sorting - see @c KeyList::sortUnique() . The region key occupies the high 48 bits, biased to be unsigned, while
+/// the local key uses only the bits required by the region voxel dimensions in the low bits. Packed keys therefore
+/// order by region first, grouping the keys of each region together. The @c Key::kNull round trips.
+///
+/// Packing is only available when the local key bits fit into the low 16 bits, which supports region voxel
+/// dimensions up to 32x32x64 (in any axis order). Check @c isValid() before use.
+class ohm_API KeyPacker
+{
+public:
+  /// Number of bits used by the packed region key.
+  static const unsigned kRegionBits = 48u;
+
+  /// Create a packer for maps with @p region_dim voxels in each region.
+  /// @param region_dim The region voxel dimensions - see @c OccupancyMap::regionVoxelDimensions() .
+  explicit KeyPacker(const glm::u8vec3 &region_dim);
+
+  /// Can this packer represent all keys for the region voxel dimensions?
+  /// @return True if packing is supported.
+  inline bool isValid() const { return valid_; }
+
+  /// Query the number of low bits used to pack the local key. Bits above @c localBits() + @c kRegionBits are zero.
+  /// @return The local key bit count.
+  inline unsigned localBits() const { return local_shift_.z + local_bits_.z; }
+
+  /// Pack @p key . Only call when @c isValid() .
+  /// @param key The key to pack. Must be valid for the region voxel dimensions.
+  /// @return The packed key.
+  inline uint64_t pack(const Key &key) const
+  {
+    const glm::i16vec3 &region = key.regionKey();
+    const glm::u8vec3 &local = key.localKey();
+    // Bias the signed region coordinates so the packed values order as the signed values.
+    const uint64_t packed_region = uint64_t(uint16_t(region.x + 0x8000)) |
+                                   (uint64_t(uint16_t(region.y + 0x8000)) << 16u) |
+                                   (uint64_t(uint16_t(region.z + 0x8000)) << 32u);
+    const uint64_t packed_local =
+      uint64_t(local.x) | (uint64_t(local.y) << local_shift_.y) | (uint64_t(local.z) << local_shift_.z);
+    return (packed_region << localBits()) | packed_local;
+  }
+
+  /// Unpack a key packed by @c pack() . Only call when @c isValid() .
+  /// @param packed The packed key.
+  /// @return The unpacked key.
+  inline Key unpack(uint64_t packed) const
+  {
+    const unsigned local_bits = localBits();
+    const uint64_t packed_region = packed >> local_bits;
+    const glm::i16vec3 region(int16_t(int(packed_region & 0xffffu) - 0x8000),
+                              int16_t(int((packed_region >> 16u) & 0xffffu) - 0x8000),
+                              int16_t(int((packed_region >> 32u) & 0xffffu) - 0x8000));
+    const glm::u8vec3 local(uint8_t(packed & localMask(0)), uint8_t((packed >> local_shift_.y) & localMask(1)),
+                            uint8_t((packed >> local_shift_.z) & localMask(2)));
+    return Key(region, local);
+  }
+
+private:
+  inline uint64_t localMask(int axis) const { return (uint64_t(1) << local_bits_[axis]) - 1u; }
+
+  glm::u8vec3 local_bits_{ 0, 0, 0 };
+  glm::u8vec3 local_shift_{ 0, 0, 0 };
+  bool valid_ = false;
+};
+}  // namespace ohm
+
+#endif  // OHM_KEYPACKER_H
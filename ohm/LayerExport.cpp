@@ -0,0 +1,214 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "LayerExport.h"
+
+#include "Key.h"
+#include "KeyRange.h"
+#include "MapChunk.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "OccupancyUtil.h"
+#include "VoxelBlock.h"
+#include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace ohm
+{
+LayerExport::LayerExport(const OccupancyMap &map, unsigned flags)
+  : map_(map)
+  , flags_(flags)
+{}
+
+
+int LayerExport::addLayer(const char *layer_name)
+{
+  const MapLayer *layer = map_.layout().layer(layer_name);
+  if (!layer || layer->dimensions(map_.regionVoxelDimensions()) != map_.regionVoxelDimensions())
+  {
+    return -1;
+  }
+
+  Column column;
+  column.layer_index = int(layer->layerIndex());
+  column.voxel_byte_size = layer->voxelByteSize();
+  // Start in line with any existing data.
+  column.data.resize(voxel_count_ * column.voxel_byte_size);
+  columns_.emplace_back(std::move(column));
+  return int(columns_.size() - 1);
+}
+
+
+const MapLayer &LayerExport::columnLayer(unsigned column) const
+{
+  return map_.layout().layer(columns_[column].layer_index);
+}
+
+
+const uint8_t *LayerExport::columnData(unsigned column) const
+{
+  return columns_[column].data.data();
+}
+
+
+size_t LayerExport::columnByteSize(unsigned column) const
+{
+  return columns_[column].data.size();
+}
+
+
+void LayerExport::clear()
+{
+  for (auto &column : columns_)
+  {
+    column.data.clear();
+  }
+  for (auto &positions : positions_)
+  {
+    positions.clear();
+  }
+  voxel_count_ = 0;
+}
+
+
+size_t LayerExport::exportRange(const KeyRange &range)
+{
+  if (!range.isValid())
+  {
+    return 0;
+  }
+
+  const glm::ivec3 dim = map_.regionVoxelDimensions();
+  const Key &min_key = range.minKey();
+  const Key &max_key = range.maxKey();
+  size_t added = 0;
+  for (int z = min_key.regionKey().z; z <= max_key.regionKey().z; ++z)
+  {
+    for (int y = min_key.regionKey().y; y <= max_key.regionKey().y; ++y)
+    {
+      for (int x = min_key.regionKey().x; x <= max_key.regionKey().x; ++x)
+      {
+        const glm::ivec3 region_coord(x, y, z);
+        glm::ivec3 local_min(0);
+        glm::ivec3 local_max = dim - glm::ivec3(1);
+        for (int a = 0; a < 3; ++a)
+        {
+          local_min[a] = (region_coord[a] == min_key.regionKey()[a]) ? int(min_key.localKey()[a]) : 0;
+          local_max[a] = (region_coord[a] == max_key.regionKey()[a]) ? int(max_key.localKey()[a]) : dim[a] - 1;
+        }
+        added += exportRegion(glm::i16vec3(region_coord), local_min, local_max);
+      }
+    }
+  }
+
+  return added;
+}
+
+
+size_t LayerExport::exportRegions(const std::vector<glm::i16vec3> &region_keys)
+{
+  const glm::ivec3 local_max = glm::ivec3(map_.regionVoxelDimensions()) - glm::ivec3(1);
+  size_t added = 0;
+  for (const auto &region_key : region_keys)
+  {
+    added += exportRegion(region_key, glm::ivec3(0), local_max);
+  }
+  return added;
+}
+
+
+size_t LayerExport::exportRegion(const glm::i16vec3 &region_key, const glm::ivec3 &local_min,
+                                 const glm::ivec3 &local_max)
+{
+  const MapChunk *chunk = map_.region(region_key);
+  if (!chunk)
+  {
+    return 0;
+  }
+
+  const glm::ivec3 dim = map_.regionVoxelDimensions();
+  const int occupancy_layer = map_.layout().occupancyLayer();
+  const bool skip_unobserved = (flags_ & kSkipUnobserved) && occupancy_layer >= 0;
+  const bool with_positions = !(flags_ & kNoPositions);
+
+  // Retain the voxel buffers for the region. This decompresses each layer once.
+  std::vector<VoxelBuffer<const VoxelBlock>> buffers;
+  buffers.reserve(columns_.size());
+  for (const auto &column : columns_)
+  {
+    buffers.emplace_back(chunk->voxel_blocks[column.layer_index]);
+  }
+  VoxelBuffer<const VoxelBlock> occupancy_buffer;
+  if (skip_unobserved)
+  {
+    occupancy_buffer = VoxelBuffer<const VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
+  }
+
+  // All layers share the same dimensions and therefore the same voxel order.
+  const VoxelOrder voxel_order = map_.layerVoxelOrder((columns_.empty()) ? occupancy_layer : columns_[0].layer_index);
+
+  // Reserve for the worst case.
+  const size_t max_count = size_t(volumeOf(local_max - local_min + glm::ivec3(1)));
+  for (auto &column : columns_)
+  {
+    column.data.reserve(column.data.size() + max_count * column.voxel_byte_size);
+  }
+  if (with_positions)
+  {
+    for (auto &positions : positions_)
+    {
+      positions.reserve(positions.size() + max_count);
+    }
+  }
+
+  size_t added = 0;
+  for (int z = local_min.z; z <= local_max.z; ++z)
+  {
+    for (int y = local_min.y; y <= local_max.y; ++y)
+    {
+      for (int x = local_min.x; x <= local_max.x; ++x)
+      {
+        const glm::u8vec3 local_key(x, y, z);
+        const unsigned voxel_index = voxelIndex(local_key, dim, voxel_order);
+        if (skip_unobserved)
+        {
+          float occupancy = 0;
+          occupancy_buffer.readVoxel(voxel_index, &occupancy);
+          if (occupancy == unobservedOccupancyValue())
+          {
+            continue;
+          }
+        }
+
+        for (size_t c = 0; c < columns_.size(); ++c)
+        {
+          Column &column = columns_[c];
+          const size_t stride = (buffers[c].voxelStride()) ? buffers[c].voxelStride() : column.voxel_byte_size;
+          const uint8_t *src = buffers[c].voxelMemory() + voxel_index * stride;
+          column.data.insert(column.data.end(), src, src + column.voxel_byte_size);
+        }
+
+        if (with_positions)
+        {
+          const glm::dvec3 centre = map_.voxelCentreGlobal(Key(region_key, local_key));
+          positions_[0].emplace_back(centre.x);
+          positions_[1].emplace_back(centre.y);
+          positions_[2].emplace_back(centre.z);
+        }
+        ++added;
+      }
+    }
+  }
+
+  voxel_count_ += added;
+  return added;
+}
+}  // namespace ohm
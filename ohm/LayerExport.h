@@ -0,0 +1,132 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_LAYEREXPORT_H
+#define OHM_LAYEREXPORT_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+class KeyRange;
+class MapLayer;
+class OccupancyMap;
+
+/// Exports voxel data from selected map layers into contiguous, structure of arrays (SoA) buffers.
+///
+/// Each layer added via @c addLayer() becomes a column of raw voxel data, where each voxel occupies
+/// @c MapLayer::voxelByteSize() bytes exactly as stored in the map - e.g., a @c float for occupancy or a @c VoxelMean
+/// for the mean layer. The @c MapLayer::voxelLayout() may be used to describe the column content to external tools,
+/// such as a NumPy structured dtype. The voxel centres are exported in separate x, y, z columns. All columns share the
+/// same voxel ordering, so the Nth entry in each column refers to the same voxel.
+///
+/// Data are copied directly from each @c MapChunk layer buffer with no per voxel type dispatch. Voxels are visited
+/// region by region, then in row major order within each region.
+///
+/// Typical usage:
+/// @code
+/// ohm::LayerExport exporter(map);
+/// exporter.addLayer(ohm::default_layer::occupancyLayerName());
+/// exporter.addLayer(ohm::default_layer::meanLayerName());
+/// exporter.exportRange(range);
+/// const float *occupancy = reinterpret_cast<const float *>(exporter.columnData(0));
+/// const ohm::VoxelMean *mean = reinterpret_cast<const ohm::VoxelMean *>(exporter.columnData(1));
+/// @endcode
+class ohm_API LayerExport
+{
+public:
+  /// Export option flags.
+  enum Flag : unsigned
+  {
+    /// Skip voxels which are unobserved in the occupancy layer. Requires an occupancy layer.
+    kSkipUnobserved = (1u << 0u),
+    /// Do not export voxel centre positions.
+    kNoPositions = (1u << 1u),
+  };
+
+  /// Constructor.
+  /// @param map The map to export from. Must outlive this object.
+  /// @param flags Export options. See @c Flag .
+  explicit LayerExport(const OccupancyMap &map, unsigned flags = kSkipUnobserved);
+
+  /// Query the export flags.
+  /// @return The @c Flag values.
+  inline unsigned flags() const { return flags_; }
+  /// Set the export flags. Affects subsequent exports only.
+  /// @param flags The new @c Flag values.
+  inline void setFlags(unsigned flags) { flags_ = flags; }
+
+  /// Add a layer to export as a column. Layers which are subsampled relative to the map regions are not supported.
+  /// @param layer_name Name of the layer to export.
+  /// @return The column index for the layer, or -1 if the layer is not present or not supported.
+  int addLayer(const char *layer_name);
+
+  /// Query the number of layer columns.
+  /// @return The number of layers added by @c addLayer() .
+  inline unsigned columnCount() const { return unsigned(columns_.size()); }
+
+  /// Query the map layer exported by a column.
+  /// @param column The column index.
+  /// @return The exported @c MapLayer .
+  const MapLayer &columnLayer(unsigned column) const;
+
+  /// Access the raw data for a column. The data contains @c voxelCount() entries of @c MapLayer::voxelByteSize() bytes.
+  /// @param column The column index.
+  /// @return A pointer to the contiguous column data.
+  const uint8_t *columnData(unsigned column) const;
+
+  /// Query the size of a column's data in bytes.
+  /// @param column The column index.
+  /// @return The column data size.
+  size_t columnByteSize(unsigned column) const;
+
+  /// Access the voxel centre coordinate values along the given @p axis .
+  /// @param axis The axis index; 0, 1, 2 => x, y, z.
+  /// @return The voxel centre coordinates. Empty when @c kNoPositions is set.
+  inline const std::vector<double> &positions(int axis) const { return positions_[axis]; }
+
+  /// Query the number of voxels exported.
+  /// @return The exported voxel count.
+  inline size_t voxelCount() const { return voxel_count_; }
+
+  /// Clear any previously exported data, retaining the selected columns.
+  void clear();
+
+  /// Export the voxels in @p range , appending to any existing data. Only voxels in existing regions are exported.
+  /// @param range The voxel range to export.
+  /// @return The number of voxels added.
+  size_t exportRange(const KeyRange &range);
+
+  /// Export all voxels in the given regions, appending to any existing data. Missing regions are ignored.
+  /// @param region_keys The regions to export.
+  /// @return The number of voxels added.
+  size_t exportRegions(const std::vector<glm::i16vec3> &region_keys);
+
+private:
+  /// Export the voxels of @p region_key in the local range [@p local_min, @p local_max] (inclusive).
+  size_t exportRegion(const glm::i16vec3 &region_key, const glm::ivec3 &local_min, const glm::ivec3 &local_max);
+
+  /// Exported column details.
+  struct Column
+  {
+    int layer_index = -1;
+    size_t voxel_byte_size = 0;
+    std::vector<uint8_t> data;
+  };
+
+  const OccupancyMap &map_;
+  std::vector<Column> columns_;
+  std::vector<double> positions_[3];  // NOLINT(modernize-avoid-c-arrays)
+  size_t voxel_count_ = 0;
+  unsigned flags_ = 0;
+};
+}  // namespace ohm
+
+#endif  // OHM_LAYEREXPORT_H
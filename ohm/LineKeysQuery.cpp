@@ -11,9 +11,15 @@
 #include "KeyList.h"
 #include "OccupancyMap.h"
 #include "OccupancyUtil.h"
+#include "TaskArena.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
 #include <algorithm>
 #include <chrono>
 #include <cstring>
@@ -35,6 +41,69 @@ unsigned nextPow2(unsigned v)
   v++;
   return v;
 }
+
+
+/// Number of rays per independently calculated block in @c lineKeysQueryCpu() .
+constexpr size_t kRaysPerBlock = 1024u;
+
+
+/// Calculate the keys for all rays in @p d , appending to @c LineKeysQueryDetail::intersected_voxels .
+///
+/// Rays are split into fixed size blocks, each calculated into a block local @c SegmentKeys , in parallel when
+/// @p use_threads is set. Blocks are then laid out in ray order, so the results do not depend on the threading.
+bool lineKeysQueryCpu(LineKeysQueryDetail &d, bool use_threads)
+{
+  const size_t ray_count = d.rays.size() / 2;
+  const size_t block_count = (ray_count + kRaysPerBlock - 1) / kRaysPerBlock;
+  std::vector<SegmentKeys> blocks(block_count);
+
+  const auto calculate_blocks = [&d, &blocks, ray_count](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; ++b)
+    {
+      const size_t first_ray = b * kRaysPerBlock;
+      const size_t block_rays = std::min(kRaysPerBlock, ray_count - first_ray);
+      calculateSegmentKeysBatch(blocks[b], *d.map, d.rays.data() + first_ray * 2, block_rays * 2, true);
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, block_count),
+                        [&calculate_blocks](const tbb::blocked_range<size_t> &range) {
+                          calculate_blocks(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    calculate_blocks(0, block_count);
+  }
+
+  // Lay out the blocks in ray order.
+  d.result_indices.resize(ray_count);
+  d.result_counts.resize(ray_count);
+  size_t key_index = d.intersected_voxels.size();
+  for (size_t b = 0; b < block_count; ++b)
+  {
+    const SegmentKeys &block = blocks[b];
+    const size_t first_ray = b * kRaysPerBlock;
+    for (size_t i = 0; i < block.ray_offsets.size(); ++i)
+    {
+      d.result_indices[first_ray + i] = key_index + block.ray_offsets[i];
+      d.result_counts[first_ray + i] = block.ray_counts[i];
+    }
+    d.intersected_voxels.insert(d.intersected_voxels.end(), block.keys.begin(), block.keys.end());
+    key_index += block.keys.size();
+  }
+
+  d.number_of_results = d.result_indices.size();
+
+  return true;
+}
 }  // namespace
 
 LineKeysQuery::LineKeysQuery(LineKeysQueryDetail *detail)
@@ -58,6 +127,8 @@ LineKeysQuery::LineKeysQuery(unsigned query_flags)
 
 LineKeysQuery::~LineKeysQuery()
 {
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
   auto *d = static_cast<LineKeysQueryDetail *>(imp_);
   delete d;
   imp_ = nullptr;
@@ -104,24 +175,12 @@ bool LineKeysQuery::onExecute()
 {
   auto *d = static_cast<LineKeysQueryDetail *>(imp_);
 
-  KeyList key_list;
-  d->result_indices.resize(d->rays.size() / 2);
-  d->result_counts.resize(d->rays.size() / 2);
-  for (size_t i = 0; i < d->rays.size(); i += 2)
+  if (!d->map)
   {
-    key_list.clear();
-    calculateSegmentKeys(key_list, *d->map, d->rays[i + 0], d->rays[i + 1], true);
-    d->result_indices[i / 2] = d->intersected_voxels.size();
-    d->result_counts[i / 2] = key_list.size();
-    for (auto &&key : key_list)
-    {
-      d->intersected_voxels.push_back(key);
-    }
+    return false;
   }
 
-  d->number_of_results = d->result_indices.size();
-
-  return true;
+  return lineKeysQueryCpu(*d, useThreads());
 }
 
 
@@ -129,17 +188,12 @@ bool LineKeysQuery::onExecuteAsync()
 {
   auto *d = static_cast<LineKeysQueryDetail *>(imp_);
 
-  if ((d->query_flags & kQfGpuEvaluate))
+  if (!d->map)
   {
-    static bool once = false;
-    if (!once)
-    {
-      once = true;
-      std::cerr << "GPU unavailable for LineKeysQuery. Failing async call.\n" << std::flush;
-    }
+    return false;
   }
 
-  return false;
+  return executeCpuAsync([this]() { return LineKeysQuery::onExecute(); });
 }
 
 
@@ -21,14 +21,16 @@ struct LineKeysQueryDetail;
 ///
 /// The results are similar to those of @c OccupancyMap::calculateSegmentKeys() (identical when using CPU),
 /// but supports batched and GPU based calculation. The GPU calculation is generally only marginally faster
-/// than CPU, but GPU supports @c executeAsync(), which is not supported for CPU.
+/// than CPU.
 ///
-/// In practice, this query isn't very useful as the GPU performance gains are minimal.
+/// The CPU implementation splits the rays into blocks calculated in parallel when built with @c OHM_FEATURE_THREADS
+/// and @c useThreads() is set. The results are laid out in ray order regardless of threading. @c executeAsync() runs
+/// the CPU query on a background thread; the query and the map must not be modified until @c wait() returns true.
 ///
 /// General usage is:
 /// - Initialise the query object setting the map and the GPU flag if required.
 /// - Call @c setRays() to define the ray start/end point pairs.
-/// - Call @c execute() or @c executeAsync() followed by @c wait() (GPU only).
+/// - Call @c execute() or @c executeAsync() followed by @c wait().
 /// - Process results (see below).
 ///
 /// The @c numberOfResults() will match the number of rays (@c pointCount given to @c setRays()) and for
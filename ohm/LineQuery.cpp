@@ -8,7 +8,10 @@
 #include "CalculateSegmentKeys.h"
 #include "Key.h"
 #include "OccupancyMap.h"
+#include "OccupancySummary.h"
 #include "QueryFlag.h"
+#include "TaskArena.h"
+#include "VoxelRangeCache.h"
 #include "private/LineQueryDetail.h"
 #include "private/OccupancyMapDetail.h"
 #include "private/OccupancyQueryAlg.h"
@@ -37,13 +40,22 @@ void calculateNearestNeighboursRange(LineQueryDetail &query, size_t start_index,
                                      const OccupancyMap &map, const glm::ivec3 &voxel_search_half_extents)
 {
   float range;
+  const bool unknown_as_occupied = (query.query_flags & kQfUnknownAsOccupied) != 0;
+  VoxelRangeCache *range_cache = (query.query_flags & kQfNoCache) ? nullptr : query.range_cache;
 
   for (size_t i = start_index; i < end_index; ++i)
   {
     const Key &key = query.segment_keys[i];
-    range =
-      calculateNearestNeighbour(key, map, voxel_search_half_extents, (query.query_flags & kQfUnknownAsOccupied) != 0,
-                                false, query.search_radius, query.axis_scaling);
+    if (range_cache)
+    {
+      range = range_cache->range(key, map, voxel_search_half_extents, unknown_as_occupied, false, query.search_radius,
+                                 query.axis_scaling);
+    }
+    else
+    {
+      range = calculateNearestNeighbour(key, map, voxel_search_half_extents, unknown_as_occupied, false,
+                                        query.search_radius, query.axis_scaling);
+    }
     // if (range < 0)
     // {
     //   range = query.default_range;
@@ -53,11 +65,16 @@ void calculateNearestNeighboursRange(LineQueryDetail &query, size_t start_index,
   }
 }
 
-unsigned occupancyLineQueryCpu(const OccupancyMap &map, LineQueryDetail &query, ClosestResult &closest)
+unsigned occupancyLineQueryCpu(OccupancyMap &map, LineQueryDetail &query, ClosestResult &closest)
 {
   glm::ivec3 voxel_search_half_extents = calculateVoxelSearchHalfExtents(map, query.search_radius);
   calculateSegmentKeys(query.segment_keys, map, query.start_point, query.end_point);
 
+  // Bring the occupancy summaries up to date before the (threaded) search so the search can skip empty bricks.
+  const glm::dvec3 search_padding(map.resolution() * (voxel_search_half_extents.x + 1));
+  updateOccupancySummaries(map, glm::min(query.start_point, query.end_point) - search_padding,
+                           glm::max(query.start_point, query.end_point) + search_padding);
+
   // Allocate results.
   query.intersected_voxels.resize(query.segment_keys.size());
   query.ranges.resize(query.segment_keys.size());
@@ -67,7 +84,9 @@ unsigned occupancyLineQueryCpu(const OccupancyMap &map, LineQueryDetail &query,
   const auto parallel_query_func = [&query, &map, voxel_search_half_extents](const tbb::blocked_range<size_t> &range) {
     calculateNearestNeighboursRange(query, range.begin(), range.end(), map, voxel_search_half_extents);
   };
-  tbb::parallel_for(tbb::blocked_range<size_t>(0u, query.segment_keys.size()), parallel_query_func);
+  parallelExecute([&]() {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0u, query.segment_keys.size()), parallel_query_func);
+  });
 
 #else   // OHM_FEATURE_THREADS
   calculateNearestNeighboursRange(query, 0u, query.segment_keys.size(), map, voxel_search_half_extents);
@@ -113,6 +132,8 @@ LineQuery::LineQuery(OccupancyMap &map, const glm::dvec3 &start_point, const glm
 
 LineQuery::~LineQuery()
 {
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
   LineQueryDetail *d = imp();
   delete d;
   // Clear pointer for base class.
@@ -190,6 +211,20 @@ void LineQuery::setAxisScaling(const glm::vec3 &scaling)
 }
 
 
+VoxelRangeCache *LineQuery::rangeCache() const
+{
+  const LineQueryDetail *d = imp();
+  return d->range_cache;
+}
+
+
+void LineQuery::setRangeCache(VoxelRangeCache *cache)
+{
+  LineQueryDetail *d = imp();
+  d->range_cache = cache;
+}
+
+
 bool LineQuery::onExecute()
 {
   LineQueryDetail *d = imp();
@@ -221,7 +256,14 @@ bool LineQuery::onExecute()
 
 bool LineQuery::onExecuteAsync()
 {
-  return false;
+  LineQueryDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return executeCpuAsync([this]() { return LineQuery::onExecute(); });
 }
 
 
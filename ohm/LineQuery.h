@@ -16,6 +16,7 @@
 namespace ohm
 {
 class GpuMap;
+class VoxelRangeCache;
 struct LineQueryDetail;
 
 /// A line segment intersection query for an @c OccupancyMap.
@@ -147,6 +148,21 @@ public:
   /// @param scaling The new axis scaling to apply.
   void setAxisScaling(const glm::vec3 &scaling);
 
+  /// Get the external voxel range cache used by the CPU query.
+  /// @return The range cache, or null when not using one.
+  VoxelRangeCache *rangeCache() const;
+
+  /// Set an external voxel range cache for the CPU query. The cache persists across executions and may be shared by
+  /// many queries, including concurrently executing queries, so that repeated queries over unchanged parts of the map
+  /// reuse previously calculated voxel ranges. Cached ranges are invalidated as the map changes. See
+  /// @c VoxelRangeCache .
+  ///
+  /// The cache is not used when @c kQfNoCache is set, which is part of the @c kDefaultFlags . The query does not take
+  /// ownership of the @p cache , which must outlive any execution using it.
+  ///
+  /// @param cache The range cache to use. May be null to disable.
+  void setRangeCache(VoxelRangeCache *cache);
+
 protected:
   bool onExecute() override;
   bool onExecuteAsync() override;
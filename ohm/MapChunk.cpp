@@ -31,9 +31,22 @@ MapChunk::MapChunk(const MapRegion &region, const OccupancyMapDetail &map)
   for (size_t i = 0; i < layout.layerCount(); ++i)
   {
     const MapLayer &layer = layout.layer(i);
-    voxel_blocks[i].reset(new VoxelBlock(&map, layer));
+    if (!layer.isGroupMember())
+    {
+      voxel_blocks[i].reset(new VoxelBlock(&map, layer));
+    }
     touched_stamps[i] = 0u;
   }
+
+  // Group members alias the group layer blocks allocated above.
+  for (size_t i = 0; i < layout.layerCount(); ++i)
+  {
+    const MapLayer &layer = layout.layer(i);
+    if (layer.isGroupMember())
+    {
+      voxel_blocks[i].reset(new VoxelBlock(&map, layer, voxel_blocks[layer.groupLayer()].get()));
+    }
+  }
 }
 
 
@@ -48,9 +61,12 @@ MapChunk::MapChunk(MapChunk &&other) noexcept
   , first_valid_index(std::exchange(other.first_valid_index, ~0u))
   , touched_time(std::exchange(other.touched_time, 0))
   , dirty_stamp(other.dirty_stamp.load())
+  , access_stamp(other.access_stamp.load())
   , touched_stamps(std::move(other.touched_stamps))
   , voxel_blocks(std::move(other.voxel_blocks))
   , flags(std::exchange(other.flags, 0))
+  , occupancy_summary(std::move(other.occupancy_summary))
+  , statistics(std::move(other.statistics))
 {}
 
 
@@ -110,10 +126,20 @@ void MapChunk::updateLayout(const MapLayout *new_layout,
   for (size_t i = 0; i < new_layout->layerCount(); ++i)
   {
     const MapLayer &layer = new_layout->layer(i);
-    if (!new_voxel_blocks[i])
+    if (new_voxel_blocks[i] && (layer.isGroupMember() || new_voxel_blocks[i]->groupBlock()))
+    {
+      // Group member aliases are recreated below as the group layer may have moved.
+      new_voxel_blocks[i] = nullptr;
+    }
+
+    if (layer.isGroupMember())
     {
-      // Initilised layer.
-      new_voxel_blocks[i].reset(new VoxelBlock(map, layer));
+      new_touched_stamps[i] = 0u;
+    }
+    else if (!new_voxel_blocks[i])
+    {
+      // New layer. Defer allocation and initialisation until first retained.
+      new_voxel_blocks[i].reset(new VoxelBlock(map, layer, true));
       new_touched_stamps[i] = 0u;
     }
     else
@@ -123,6 +149,15 @@ void MapChunk::updateLayout(const MapLayout *new_layout,
     }
   }
 
+  for (size_t i = 0; i < new_layout->layerCount(); ++i)
+  {
+    const MapLayer &layer = new_layout->layer(i);
+    if (layer.isGroupMember())
+    {
+      new_voxel_blocks[i].reset(new VoxelBlock(map, layer, new_voxel_blocks[layer.groupLayer()].get()));
+    }
+  }
+
   // Release redundant layers.
   const MapLayout &old_layout = layout();
   for (size_t i = 0; i < old_layout.layerCount(); ++i)
@@ -143,16 +178,59 @@ void MapChunk::updateLayout(const MapLayout *new_layout,
 }
 
 
+void MapChunk::recycle(const MapRegion &region)
+{
+  this->region = region;
+  first_valid_index = ~0u;
+  touched_time = 0;
+  dirty_stamp = 0u;
+  access_stamp = 0u;
+  flags = 0;
+  occupancy_summary.reset();
+  statistics.reset();
+  for (size_t i = 0; i < voxel_blocks.size(); ++i)
+  {
+    voxel_blocks[i]->reset();
+    touched_stamps[i] = 0u;
+  }
+}
+
+
+uint64_t MapChunk::layerTouchedStamp(unsigned layer_index) const
+{
+  const MapLayout &layout = this->layout();
+  uint64_t stamp = touched_stamps[layer_index].load(std::memory_order_relaxed);
+  for (size_t i = 0; i < layout.layerCount(); ++i)
+  {
+    if (layout.layer(i).groupLayer() == int(layer_index))
+    {
+      stamp = std::max<uint64_t>(stamp, touched_stamps[i].load(std::memory_order_relaxed));
+    }
+  }
+  return stamp;
+}
+
+
+void MapChunk::notifyDirty() const
+{
+  if (map)
+  {
+    map->notifyRegionChanged(region.coord);
+  }
+}
+
+
 void MapChunk::searchAndUpdateFirstValid(const glm::ivec3 &region_voxel_dimensions, const glm::u8vec3 &search_from)
 {
   const MapLayout &layout = this->layout();
   // First mark as unknown
   first_valid_index = ~0u;
+  const VoxelOrder order = resolveVoxelOrder(voxelOrderFromFlags(map->flags), region_voxel_dimensions);
   // Try by occupancy
   if (layout.occupancyLayer() != -1)
   {
     VoxelBuffer<const VoxelBlock> voxel_buffer(voxel_blocks[layout.occupancyLayer()]);
-    const size_t voxel_stride = layout.layer(layout.occupancyLayer()).voxelByteSize();
+    const size_t voxel_stride = layout.layer(layout.occupancyLayer()).voxelStride();
     const uint8_t *voxel_mem = voxel_buffer.voxelMemory();
 
     unsigned voxel_index = 0;
@@ -164,9 +242,12 @@ void MapChunk::searchAndUpdateFirstValid(const glm::ivec3 &region_voxel_dimensio
       {
         for (int x = search_from.x; x < region_voxel_dimensions.x; ++x)
         {
+          // The first valid index is row major, while the voxel memory follows the voxel order.
           voxel_index =
             unsigned(x) + y * region_voxel_dimensions.x + z * region_voxel_dimensions.y * region_voxel_dimensions.x;
-          memcpy(&occupancy, voxel_mem + voxel_stride * voxel_index, sizeof(occupancy));
+          memcpy(&occupancy,
+                 voxel_mem + voxel_stride * voxelIndex(glm::u8vec3(x, y, z), region_voxel_dimensions, order),
+                 sizeof(occupancy));
           if (occupancy != unobservedOccupancyValue())
           {
             first_valid_index = std::min(voxel_index, first_valid_index);
@@ -183,7 +264,7 @@ void MapChunk::searchAndUpdateFirstValid(const glm::ivec3 &region_voxel_dimensio
   {
     const int layer_index = layout.layerIndex(default_layer::tsdfLayerName());
     VoxelBuffer<const VoxelBlock> voxel_buffer(voxel_blocks[layer_index]);
-    const size_t voxel_stride = layout.layer(layer_index).voxelByteSize();
+    const size_t voxel_stride = layout.layer(layer_index).voxelStride();
     const uint8_t *voxel_mem = voxel_buffer.voxelMemory();
 
     unsigned voxel_index = 0;
@@ -197,7 +278,8 @@ void MapChunk::searchAndUpdateFirstValid(const glm::ivec3 &region_voxel_dimensio
         {
           voxel_index =
             unsigned(x) + y * region_voxel_dimensions.x + z * region_voxel_dimensions.y * region_voxel_dimensions.x;
-          memcpy(&tsdf, voxel_mem + voxel_stride * voxel_index, sizeof(tsdf));
+          memcpy(&tsdf, voxel_mem + voxel_stride * voxelIndex(glm::u8vec3(x, y, z), region_voxel_dimensions, order),
+                 sizeof(tsdf));
           if (isValidTsdf(&tsdf))
           {
             first_valid_index = std::min(voxel_index, first_valid_index);
@@ -221,8 +303,9 @@ bool MapChunk::validateFirstValid() const
 {
   const MapLayout &layout = this->layout();
   VoxelBuffer<const VoxelBlock> voxel_buffer(voxel_blocks[layout.occupancyLayer()].get());
-  const size_t voxel_stride = layout.layer(layout.occupancyLayer()).voxelByteSize();
+  const size_t voxel_stride = layout.layer(layout.occupancyLayer()).voxelStride();
   const uint8_t *voxel_mem = voxel_buffer.voxelMemory();
+  const VoxelOrder order = resolveVoxelOrder(voxelOrderFromFlags(map->flags), map->region_voxel_dimensions);
 
   unsigned voxel_index = 0;
   float occupancy;
@@ -232,7 +315,9 @@ bool MapChunk::validateFirstValid() const
     {
       for (int x = 0; x < map->region_voxel_dimensions.x; ++x)
       {
-        memcpy(&occupancy, voxel_mem + voxel_stride * voxel_index, sizeof(occupancy));
+        memcpy(&occupancy,
+               voxel_mem + voxel_stride * voxelIndex(glm::u8vec3(x, y, z), map->region_voxel_dimensions, order),
+               sizeof(occupancy));
         if (occupancy != unobservedOccupancyValue())
         {
           if (first_valid_index != voxel_index)
@@ -10,7 +10,10 @@
 
 #include "Key.h"
 #include "MapRegion.h"
+#include "OccupancySummary.h"
+#include "RegionStatistics.h"
 #include "VoxelBlock.h"
+#include "VoxelOrder.h"
 
 #include <algorithm>
 #include <atomic>
@@ -56,6 +59,40 @@ inline glm::u8vec3 voxelLocalKey(unsigned index, const glm::ivec3 &dim)
 }
 
 
+/// Convert a local voxel key into an index into a layer's voxel memory for the given @c VoxelOrder .
+///
+/// Unlike the row major overloads above, this is the index required to address voxel memory in maps with a
+/// non default @c OccupancyMap::voxelOrder() . The @p order must be resolved for the layer dimensions - see
+/// @c OccupancyMap::layerVoxelOrder() . The @c MapChunk::first_valid_index is always a row major index.
+/// @param key The local voxel key.
+/// @param dim The layer voxel dimensions.
+/// @param order The layer voxel order.
+/// @return The voxel memory index.
+inline unsigned voxelIndex(const glm::u8vec3 &key, const glm::ivec3 &dim, VoxelOrder order)
+{
+  return orderedVoxelIndex(key.x, key.y, key.z, dim.x, dim.y, dim.z, unsigned(order));
+}
+
+
+/// @overload
+inline unsigned voxelIndex(const Key &key, const glm::ivec3 &dim, VoxelOrder order)
+{
+  return voxelIndex(key.localKey(), dim, order);
+}
+
+
+/// Convert a voxel memory index for the given @c VoxelOrder back into a local voxel key. Inverse of
+/// @c voxelIndex(const glm::u8vec3 &, const glm::ivec3 &, VoxelOrder) .
+/// @param index The voxel memory index.
+/// @param dim The layer voxel dimensions.
+/// @param order The layer voxel order.
+/// @return The local voxel key.
+inline glm::u8vec3 voxelLocalKey(unsigned index, const glm::ivec3 &dim, VoxelOrder order)
+{
+  return orderedVoxelLocalKey(index, dim, order);
+}
+
+
 /// Move a region local key to the next coordinate in that region. The operation is constrained by the region
 /// dimensions @p dim.
 ///
@@ -140,7 +177,7 @@ inline bool nextLocalKey(Key &key, const glm::ivec3 &dim)
 /// - Cast the voxel memory to the expected type - e.g., @c float for occupancy, @c VoxelMean for the voxel mean layer
 /// - Resolve the @c Key::localKey() into a one dimensional index using @c voxelIndex()
 /// - Read/write to the indexed voxel as required
-/// - Update the @c MapChunk::dirty_stamp to the cached @c OccupancyMap::touch() value
+/// - Update the @c MapChunk::dirty_stamp to the cached @c OccupancyMap::touch() value via @c MapChunk::markDirty()
 /// - Update the @c MapChunk::touched_stamps for the affected layer(s) to the same touch value.
 ///     - Recommend using @c std::atomic_uint64_t::.store() with @c std::memory_order_relaxed if permitted
 ///
@@ -168,6 +205,11 @@ struct ohm_API MapChunk
   /// The map maintains the most up to date stamp: @c OccupancyMap::stamp().
   std::atomic_uint64_t dirty_stamp{ 0 };
 
+  /// The region paging epoch in which the chunk was last accessed via @c OccupancyMap::region() . Only maintained
+  /// when region paging is enabled and used to select the least recently used regions to page out.
+  /// See @c OccupancyMap::enableRegionPaging() .
+  std::atomic_uint64_t access_stamp{ 0 };
+
   /// A monotonic stamp value for each @c voxelMap, used to indicate when the layer was last updated.
   /// The map maintains the most up to date stamp: @c OccupancyMap::stamp().
   /// @note It is not possible to have a @c std::vector of atomic types. We use a unique pointer to an arrray
@@ -181,6 +223,13 @@ struct ohm_API MapChunk
   /// Chunk flags set from @c MapChunkFlag.
   unsigned flags = 0;
 
+  /// Hierarchical summary of the occupancy layer. Only maintained for maps with @c MapFlag::kOccupancySummary and
+  /// lazily built - see @c updateOccupancySummary() .
+  std::unique_ptr<RegionOccupancySummary> occupancy_summary;
+
+  /// Cached occupancy statistics for the chunk. Lazily built - see @c updateRegionStatistics() .
+  std::unique_ptr<RegionStatistics> statistics;
+
   /// Create an empty @c MapChunk object.
   MapChunk() = default;
   /// Create a @c MapChunk for the given @p map .
@@ -220,6 +269,9 @@ struct ohm_API MapChunk
 
   /// Update the @p layout for the chunk, preserving current layers which have an equivalent in @p new_layout.
   ///
+  /// Preserved layer blocks are moved, not copied. Blocks for new layers defer allocating and initialising their voxel
+  /// memory until first retained. Safe to call concurrently for different chunks.
+  ///
   /// Note: this does not change the @p layout pointer as it is assumed the object at that location is about to be
   /// updated with the information from @p new_layout.
   ///
@@ -238,6 +290,35 @@ struct ohm_API MapChunk
   /// @return True if this chunk contains at least one voxel with a valid value.
   bool hasValidNodes() const;
 
+  /// Recycle the chunk in place to represent @p region . All voxels are reset to the layer clear values, reusing the
+  /// existing voxel memory, and all stamps, flags and the touch time are cleared. The chunk must not be in use.
+  /// @param region The new region for the chunk.
+  void recycle(const MapRegion &region);
+
+  /// Set the @c dirty_stamp to @p stamp , marking the chunk as modified. Any @c RegionChangeFeed subscribed to the
+  /// owning map is notified when the stamp changes, so this should be preferred over assigning the @c dirty_stamp
+  /// directly. Batched updates should use a single stamp to notify once per chunk.
+  /// @param stamp The new dirty stamp, generally from @c OccupancyMap::touch() .
+  inline void markDirty(uint64_t stamp)
+  {
+    if (dirty_stamp.load(std::memory_order_relaxed) != stamp)
+    {
+      dirty_stamp = stamp;
+      notifyDirty();
+    }
+  }
+
+  /// Notify any @c RegionChangeFeed subscribed to the owning map that this chunk has changed. Called by
+  /// @c markDirty() .
+  void notifyDirty() const;
+
+  /// Query the effective @c touched_stamps value for @p layer_index . For a layer group, this is the most recent
+  /// stamp of the group layer and its members as updates to member layers only touch the member stamp.
+  /// See @c MapLayout::addLayerGroup() .
+  /// @param layer_index The layer of interest.
+  /// @return The effective touch stamp for the layer.
+  uint64_t layerTouchedStamp(unsigned layer_index) const;
+
   /// Set the @c first_valid_index to the unknown/invalid value.
   inline void invalidateFirstValidIndex() { first_valid_index = ~0u; }
 
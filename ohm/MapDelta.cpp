@@ -0,0 +1,223 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapDelta.h"
+
+#include "MapChunk.h"
+#include "MapSerialise.h"
+#include "OccupancyMap.h"
+
+#include "private/IndexedMapFile.h"
+#include "private/MapDeltaDetail.h"
+#include "private/MapJournal.h"
+#include "private/OccupancyMapDetail.h"
+
+#include <utility>
+
+namespace ohm
+{
+MapDeltaEncoder::MapDeltaEncoder()
+  : imp_(new MapDeltaEncoderDetail)
+{}
+
+
+MapDeltaEncoder::~MapDeltaEncoder() = default;
+
+
+void MapDeltaEncoder::setByteBudget(size_t byte_budget)
+{
+  imp_->byte_budget = byte_budget;
+}
+
+
+size_t MapDeltaEncoder::byteBudget() const
+{
+  return imp_->byte_budget;
+}
+
+
+void MapDeltaEncoder::setReferencePosition(const glm::dvec3 &position)
+{
+  imp_->pending.setReferencePosition(position);
+}
+
+
+void MapDeltaEncoder::clearReferencePosition()
+{
+  imp_->pending.clearReferencePosition();
+}
+
+
+size_t MapDeltaEncoder::pendingCount() const
+{
+  return imp_->pending.size();
+}
+
+
+uint64_t MapDeltaEncoder::lastStamp() const
+{
+  return imp_->last_stamp;
+}
+
+
+void MapDeltaEncoder::reset()
+{
+  imp_->pending.clear();
+  imp_->last_stamp = 0;
+  imp_->sent_stamp = 0;
+}
+
+
+int MapDeltaEncoder::encode(const OccupancyMap &map, const MapDeltaSink &sink, size_t *region_count)
+{
+  MapDeltaEncoderDetail &d = *imp_;
+  const OccupancyMapDetail &detail = *map.detail();
+
+  if (region_count)
+  {
+    *region_count = 0;
+  }
+
+  // Queue the regions changed since the last collection. Take the stamp first so changes made during collection are
+  // collected again next time.
+  const uint64_t stamp = map.stamp();
+  std::vector<std::pair<uint64_t, glm::i16vec3>> dirty_regions;
+  map.collectDirtyRegions(d.last_stamp, dirty_regions);
+  d.last_stamp = stamp;
+  for (const auto &dirty : dirty_regions)
+  {
+    d.pending.push(dirty.second);
+  }
+
+  if (d.pending.empty())
+  {
+    return kSeOk;
+  }
+
+  std::vector<unsigned> serialised_layers;
+  IndexedMapFile::serialisedLayers(detail.layout, serialised_layers);
+
+  // Size of the trailing commit record.
+  d.message.clear();
+  MapJournal::appendCommitRecord(detail, d.sent_stamp, 0, d.message);
+  const size_t commit_size = d.message.size();
+
+  // Replaces the commit record above.
+  MapJournal::buildHeader(detail, d.message);
+
+  std::vector<glm::i16vec3> sent_regions;
+  glm::i16vec3 region_key;
+  while (d.pending.pop(map, &region_key))
+  {
+    const MapChunk *chunk = map.region(region_key);
+    if (!chunk)
+    {
+      // Removed since it was queued.
+      continue;
+    }
+
+    d.record.clear();
+    const int err = MapJournal::appendRegionRecord(*chunk, detail, serialised_layers, d.record);
+    if (err)
+    {
+      d.pending.push(region_key);
+      for (const auto &sent_key : sent_regions)
+      {
+        d.pending.push(sent_key);
+      }
+      return err;
+    }
+
+    if (d.byte_budget && !sent_regions.empty() &&
+        d.message.size() + d.record.size() + commit_size > d.byte_budget)
+    {
+      // Over budget. Leave the region for the next message.
+      d.pending.push(region_key);
+      break;
+    }
+
+    d.message.insert(d.message.end(), d.record.begin(), d.record.end());
+    sent_regions.emplace_back(region_key);
+  }
+
+  if (sent_regions.empty())
+  {
+    return kSeOk;
+  }
+
+  MapJournal::appendCommitRecord(detail, d.sent_stamp, sent_regions.size(), d.message);
+
+  if (!sink(d.message.data(), d.message.size()))
+  {
+    for (const auto &sent_key : sent_regions)
+    {
+      d.pending.push(sent_key);
+    }
+    return kSeFileWriteFailure;
+  }
+
+  d.sent_stamp = stamp;
+  if (region_count)
+  {
+    *region_count = sent_regions.size();
+  }
+
+  return kSeOk;
+}
+
+
+int encodeMapRegions(const OccupancyMap &map, const glm::i16vec3 *region_keys, size_t region_count,
+                     std::vector<uint8_t> &message, size_t *encoded_count)
+{
+  const OccupancyMapDetail &detail = *map.detail();
+  message.clear();
+  if (encoded_count)
+  {
+    *encoded_count = 0;
+  }
+
+  std::vector<unsigned> serialised_layers;
+  IndexedMapFile::serialisedLayers(detail.layout, serialised_layers);
+
+  MapJournal::buildHeader(detail, message);
+  size_t encoded = 0;
+  for (size_t i = 0; i < region_count; ++i)
+  {
+    const MapChunk *chunk = map.region(region_keys[i]);
+    if (!chunk)
+    {
+      continue;
+    }
+
+    const int err = MapJournal::appendRegionRecord(*chunk, detail, serialised_layers, message);
+    if (err)
+    {
+      message.clear();
+      return err;
+    }
+    ++encoded;
+  }
+
+  if (!encoded)
+  {
+    message.clear();
+    return kSeOk;
+  }
+
+  MapJournal::appendCommitRecord(detail, 0, encoded, message);
+  if (encoded_count)
+  {
+    *encoded_count = encoded;
+  }
+
+  return kSeOk;
+}
+
+
+int applyMapDelta(OccupancyMap &map, const uint8_t *data, size_t byte_count, uint64_t *stamp_out)
+{
+  return MapJournal::replay(data, byte_count, map, nullptr, stamp_out);
+}
+}  // namespace ohm
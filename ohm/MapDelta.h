@@ -0,0 +1,140 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPDELTA_H
+#define OHM_MAPDELTA_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct MapDeltaEncoderDetail;
+
+/// Receives an encoded map delta message from a @c MapDeltaEncoder . The message bytes are only valid for the duration
+/// of the call.
+///
+/// Return false to indicate the message could not be sent, in which case the regions it contains are queued again.
+using MapDeltaSink = std::function<bool(const uint8_t *data, size_t byte_count)>;
+
+/// Encodes the regions changed in an @c OccupancyMap into compact binary messages for streaming to a remote copy of
+/// the map, such as for live map sharing between robots or with a base station.
+///
+/// Each call to @c encode() collects the regions changed since the previous call - see
+/// @c OccupancyMap::collectDirtyRegions() - and emits a single message to a @c MapDeltaSink . A message is a
+/// self contained in memory map journal holding the journal header, one region record per changed region and a
+/// commit record. See @c saveDelta() for the journal format. Each region's layers are independently compressed and
+/// each record carries a CRC, so a message is either applied in full by @c applyMapDelta() or rejected.
+///
+/// Messages are limited to the @c byteBudget() to rate limit the stream. Regions are prioritised by distance to the
+/// @c referencePosition() - generally the robot position - using a @c RegionScheduler , so nearby changes are sent
+/// first. Regions which do not fit within the budget remain queued for the next @c encode() . At least one region is
+/// always sent, so a single region larger than the budget does not stall the stream. A queued region is sent with its
+/// content at the time it is encoded, so regions changed repeatedly while queued are only sent once.
+///
+/// The receiving map must have the same resolution, region dimensions and serialised layers as the source map. Regions
+/// removed from the source map are not streamed.
+///
+/// @code
+/// ohm::MapDeltaEncoder encoder;
+/// encoder.setByteBudget(64 * 1024);
+/// while (running)
+/// {
+///   integrate(map);
+///   encoder.setReferencePosition(robot_position);
+///   encoder.encode(map, [&socket](const uint8_t *data, size_t size) { return socket.send(data, size); });
+/// }
+/// // Receiver:
+/// ohm::applyMapDelta(remote_map, data, size);
+/// @endcode
+class ohm_API MapDeltaEncoder
+{
+public:
+  /// Constructor.
+  MapDeltaEncoder();
+  /// Non-copyable.
+  MapDeltaEncoder(const MapDeltaEncoder &other) = delete;
+  /// Destructor.
+  ~MapDeltaEncoder();
+  /// Non-copyable.
+  MapDeltaEncoder &operator=(const MapDeltaEncoder &other) = delete;
+
+  /// Set the target maximum message size in bytes.
+  /// @param byte_budget The message byte budget. Zero for no limit.
+  void setByteBudget(size_t byte_budget);
+  /// Query the target maximum message size in bytes.
+  /// @return The message byte budget. Zero for no limit.
+  size_t byteBudget() const;
+
+  /// Set the reference position used to prioritise regions. Must be in the same frame as the source map.
+  /// @param position The reference position.
+  void setReferencePosition(const glm::dvec3 &position);
+  /// Clear the reference position, reverting to oldest first ordering.
+  void clearReferencePosition();
+
+  /// Query the number of changed regions awaiting encoding. This excludes changes made since the last @c encode() .
+  /// @return The number of queued regions.
+  size_t pendingCount() const;
+
+  /// Query the source map stamp at which changed regions were last collected.
+  /// @return The last collected stamp.
+  uint64_t lastStamp() const;
+
+  /// Clear the queued regions and collected stamp. The next @c encode() sends all regions of the map. Use after the
+  /// receiver has been reset.
+  void reset();
+
+  /// Encode the next message for the regions of @p map changed since the last call and pass it to @p sink .
+  ///
+  /// The @p sink is not called when there are no changed regions.
+  ///
+  /// @param map The source map. Must be the same map for every call until @c reset() .
+  /// @param sink Receives the encoded message.
+  /// @param[out] region_count Optionally set to the number of regions sent.
+  /// @return @c kSeOk on success, @c kSeFileWriteFailure if the @p sink fails or another @c SerialisationError code
+  ///   if a region fails to encode.
+  int encode(const OccupancyMap &map, const MapDeltaSink &sink, size_t *region_count = nullptr);
+
+private:
+  std::unique_ptr<MapDeltaEncoderDetail> imp_;
+};
+
+/// Encode the given regions of @p map into a single message in the @c MapDeltaEncoder format, for use with
+/// @c applyMapDelta() . Unlike @c MapDeltaEncoder::encode() , this ignores region changes and has no byte budget. Used
+/// to transfer specific regions between maps, such as when rebalancing a @c ShardedMap .
+///
+/// Regions not present in @p map are skipped.
+///
+/// @param map The source map.
+/// @param region_keys The regions to encode.
+/// @param region_count Number of elements in @p region_keys .
+/// @param[out] message Set to the encoded message. Left empty when no regions are encoded.
+/// @param[out] encoded_count Optionally set to the number of regions encoded.
+/// @return @c kSeOk on success or a @c SerialisationError code if a region fails to encode.
+int ohm_API encodeMapRegions(const OccupancyMap &map, const glm::i16vec3 *region_keys, size_t region_count,
+                             std::vector<uint8_t> &message, size_t *encoded_count = nullptr);
+
+/// Apply a message generated by a @c MapDeltaEncoder to @p map .
+///
+/// The message regions replace the corresponding regions in @p map . A corrupt or truncated message is ignored.
+///
+/// @param map The map to update. Must match the resolution, region dimensions and serialised layers of the source map.
+/// @param data The message bytes.
+/// @param byte_count The number of bytes in @p data .
+/// @param[out] stamp_out Optionally set to the source map stamp at which the message was encoded.
+/// @return @c kSeOk on success, @c kSeJournalMismatch if @p map does not match the source map or another
+///   @c SerialisationError code on failure.
+int ohm_API applyMapDelta(OccupancyMap &map, const uint8_t *data, size_t byte_count, uint64_t *stamp_out = nullptr);
+}  // namespace ohm
+
+#endif  // OHM_MAPDELTA_H
@@ -10,8 +10,10 @@
 
 namespace
 {
-const std::array<const char *, 3> kMapFlagNames =  //
-  { "VoxelMean", "Compressed", "Traversal" };
+const std::array<const char *, 14> kMapFlagNames =  //
+  { "VoxelMean",        "Compressed",      "Traversal",        "TouchTime",        "IncidentNormal",
+    "Tsdf",             "SecondarySample", "VoxelOrderMorton", "VoxelOrderBrick4", "UniformBlocks",
+    "OccupancySummary", "OccupancyState",  "TouchIncident",    "InterleavedLayers" };
 }  // namespace
 
 namespace ohm
@@ -32,6 +32,25 @@ enum class MapFlag : unsigned
   kTsdf = (1u << 5u),
   /// Add the secondary samples layer.
   kSecondarySample = (1u << 6u),
+  /// Store layer voxels in Morton order. See @c VoxelOrder::kMorton .
+  kVoxelOrderMorton = (1u << 7u),
+  /// Store layer voxels in 4x4x4 bricks. See @c VoxelOrder::kBrick4 .
+  kVoxelOrderBrick4 = (1u << 8u),
+  /// Elide the voxel memory for layers in a region which hold the same value for every voxel. Such layers store only a
+  /// single fill value until a non-uniform value is written. See @c VoxelBlock::kFUniform .
+  kUniformBlocks = (1u << 9u),
+  /// Maintain a hierarchical occupancy summary for each region, allowing queries to skip bricks of voxels which
+  /// cannot be occupied. See @c RegionOccupancySummary .
+  kOccupancySummary = (1u << 10u),
+  /// Maintain a 2-bit per voxel occupancy state layer: unobserved, free or occupied. Requires even region voxel
+  /// dimensions. See @c default_layer::occupancyStateLayerName() .
+  kOccupancyState = (1u << 11u),
+  /// Maintain the touch time and incident normal together in a single packed layer. An alternative to
+  /// @c kTouchTime and @c kIncidentNormal which updates both with one voxel access. See @c VoxelTouchIncident .
+  kTouchIncident = (1u << 12u),
+  /// Interleave the occupancy, @c kVoxelMean and @c kTraversal layers in a single layer group so each sample update
+  /// touches one cache line rather than one per layer. See @c addOccupancyGroup() . Not supported by GPU maps.
+  kInterleavedLayers = (1u << 13u),
 
   /// Default map creation flags.
   kDefault = kCompressed
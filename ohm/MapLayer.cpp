@@ -111,6 +111,20 @@ size_t MapLayer::voxelByteSize() const
 }
 
 
+size_t MapLayer::voxelStride() const
+{
+  return (group_layer_ >= 0) ? group_stride_ : voxel_layout_->voxel_byte_size;
+}
+
+
+void MapLayer::setGroup(int group_layer, unsigned group_offset, unsigned group_stride)
+{
+  group_layer_ = group_layer;
+  group_offset_ = uint16_t((group_layer >= 0) ? group_offset : 0u);
+  group_stride_ = uint16_t((group_layer >= 0) ? group_stride : 0u);
+}
+
+
 size_t MapLayer::layerByteSize(const glm::u8vec3 &region_dim) const
 {
   // Apply subsampling
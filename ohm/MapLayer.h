@@ -32,7 +32,10 @@ public:
   enum Flag
   {
     /// Layer data is not serialised to disk.
-    kSkipSerialise = (1u << 0u)
+    kSkipSerialise = (1u << 0u),
+    /// Layer voxels are interleaved with other layers in a group layer and the layer has no storage of its own. See
+    /// @c MapLayout::addLayerGroup() .
+    kGroupMember = (1u << 1u)
   };
 
   /// Construct a new layer.
@@ -67,6 +70,29 @@ public:
   /// @param flags New flags to set.
   inline void setFlags(unsigned flags) { flags_ = flags; }
 
+  /// Query if this layer is a member of a layer group, with voxels interleaved in the @c groupLayer() .
+  /// @return True if the layer is a group member.
+  inline bool isGroupMember() const { return (flags_ & kGroupMember) != 0; }
+
+  /// Query the index of the group layer which stores the voxels of this layer. See @c MapLayout::addLayerGroup() .
+  /// @return The group layer index, or -1 if this is not a group member.
+  inline int groupLayer() const { return group_layer_; }
+
+  /// Query the byte offset of this layer's voxel data within each @c groupLayer() voxel.
+  /// @return The byte offset into each group voxel, or zero if this is not a group member.
+  inline unsigned groupOffset() const { return group_offset_; }
+
+  /// Query the byte stride between consecutive voxels of this layer. This is the @c voxelByteSize() of the
+  /// @c groupLayer() for group members, or the @c voxelByteSize() of this layer otherwise.
+  /// @return The voxel byte stride.
+  size_t voxelStride() const;
+
+  /// Set the layer group details. For use by @c MapLayout only.
+  /// @param group_layer The group layer index, or -1 to clear.
+  /// @param group_offset Byte offset of this layer's data in each group voxel.
+  /// @param group_stride The group layer voxel byte size.
+  void setGroup(int group_layer, unsigned group_offset, unsigned group_stride);
+
   /// Copy the @c VoxelLayout from @p other.
   /// @param other Layer to copy the voxel structure of.
   void copyVoxelLayout(const MapLayer &other);
@@ -150,6 +176,9 @@ private:
   uint16_t layer_index_ = 0;
   uint16_t subsampling_ = 0;
   unsigned flags_ = 0;
+  int group_layer_ = -1;
+  uint16_t group_offset_ = 0;
+  uint16_t group_stride_ = 0;
 };
 }  // namespace ohm
 
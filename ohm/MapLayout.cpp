@@ -14,6 +14,7 @@
 
 #include <algorithm>
 #include <list>
+#include <stdexcept>
 #include <string>
 
 namespace ohm
@@ -214,17 +215,33 @@ void MapLayout::filterLayers(const std::initializer_list<const char *> &preserve
     }
   }
 
-  ohm::filterLayers(*imp_, preserve_indices);
-  // Rebind the layer index caches.
-  cacheLayerIndices();
+  filterLayerIndices(preserve_indices);
 }
 
 
 void MapLayout::filterLayers(const std::initializer_list<unsigned> &preserve_layers)
 {
+  filterLayerIndices(std::vector<unsigned>(preserve_layers));
+}
+
+
+void MapLayout::filterLayerIndices(std::vector<unsigned> preserve_layers)
+{
+  // Preserve the group layers of any preserved group members: they hold the member voxels.
+  const size_t preserve_count = preserve_layers.size();
+  for (size_t i = 0; i < preserve_count; ++i)
+  {
+    const MapLayer *layer = layerPtr(preserve_layers[i]);
+    if (layer && layer->groupLayer() >= 0)
+    {
+      preserve_layers.emplace_back(unsigned(layer->groupLayer()));
+    }
+  }
+
   ohm::filterLayers(*imp_, preserve_layers);
   // Rebind the layer index caches.
   cacheLayerIndices();
+  resolveLayerGroups();
 }
 
 
@@ -238,6 +255,110 @@ MapLayer *MapLayout::addLayer(const char *name, uint16_t subsampling)
 }
 
 
+MapLayer *MapLayout::addLayerGroup(const char *name, const std::initializer_list<const char *> &member_layers)
+{
+  std::vector<MapLayer *> members;
+  for (const char *member_name : member_layers)
+  {
+    const int member_index = layerIndex(member_name);
+    MapLayer *member = layerPtr(member_index);
+    if (!member || member->isGroupMember() || member->voxelLayout().memberCount() == 0 ||
+        (!members.empty() && member->subsampling() != members[0]->subsampling()))
+    {
+      return nullptr;
+    }
+    members.emplace_back(member);
+  }
+
+  if (members.empty())
+  {
+    return nullptr;
+  }
+
+  MapLayer *group = addLayer(name, uint16_t(members[0]->subsampling()));
+  VoxelLayout group_voxel = group->voxelLayout();
+  size_t member_end = 0;
+  for (MapLayer *member : members)
+  {
+    const VoxelLayoutConst member_voxel = member->voxelLayout();
+    const size_t group_member_start = group_voxel.memberCount();
+    for (size_t i = 0; i < member_voxel.memberCount(); ++i)
+    {
+      const std::string member_name = std::string(member->name()) + "." + member_voxel.memberName(i);
+      group_voxel.addMember(member_name.c_str(), member_voxel.memberType(i), member_voxel.memberClearValue(i));
+    }
+
+    // The member voxel must appear at the same relative offsets in the group voxel and must not overlap the previous
+    // member voxel, including its padding.
+    const size_t base_offset = group_voxel.memberOffset(group_member_start);
+    if (base_offset < member_end)
+    {
+      throw std::runtime_error("Layer group member overlap");
+    }
+    for (size_t i = 0; i < member_voxel.memberCount(); ++i)
+    {
+      if (group_voxel.memberOffset(group_member_start + i) - base_offset != member_voxel.memberOffset(i))
+      {
+        throw std::runtime_error("Layer group member layout mismatch");
+      }
+    }
+    member_end = base_offset + member_voxel.voxelByteSize();
+
+    member->setFlags(member->flags() | MapLayer::kGroupMember);
+  }
+
+  if (group_voxel.voxelByteSize() < member_end)
+  {
+    throw std::runtime_error("Layer group member overlap");
+  }
+
+  resolveLayerGroups();
+  return group;
+}
+
+
+void MapLayout::resolveLayerGroups()
+{
+  for (MapLayer *layer : imp_->layers)
+  {
+    layer->setGroup(-1, 0, 0);
+  }
+
+  for (MapLayer *layer : imp_->layers)
+  {
+    if (!layer->isGroupMember())
+    {
+      continue;
+    }
+
+    // Find the group layer by the name of the first member data field: "<layer>.<member>".
+    const VoxelLayoutConst member_voxel = layer->voxelLayout();
+    bool resolved = false;
+    if (member_voxel.memberCount())
+    {
+      const std::string group_member_name = std::string(layer->name()) + "." + member_voxel.memberName(0);
+      for (const MapLayer *group : imp_->layers)
+      {
+        const VoxelLayoutConst group_voxel = group->voxelLayout();
+        const int group_member_index = (!group->isGroupMember()) ? group_voxel.indexOf(group_member_name.c_str()) : -1;
+        if (group_member_index >= 0 && group->subsampling() == layer->subsampling())
+        {
+          layer->setGroup(int(group->layerIndex()), unsigned(group_voxel.memberOffset(group_member_index)),
+                          unsigned(group_voxel.voxelByteSize()));
+          resolved = true;
+          break;
+        }
+      }
+    }
+
+    if (!resolved)
+    {
+      layer->setFlags(layer->flags() & ~unsigned(MapLayer::kGroupMember));
+    }
+  }
+}
+
+
 void MapLayout::cacheLayerIndex(const MapLayer *layer)
 {
   if (layer)
@@ -366,7 +487,9 @@ MapLayout &MapLayout::operator=(const MapLayout &other)
       {
         MapLayer *new_layer = addLayer(layer->name(), layer->subsampling());
         new_layer->copyVoxelLayout(*layer);
+        new_layer->setFlags(layer->flags());
       }
+      resolveLayerGroups();
     }
   }
   return *this;
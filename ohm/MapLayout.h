@@ -194,6 +194,31 @@ public:
   /// @return The new layer. The @c MapLayer::layerIndex() serves as it's id for use with @c layer() calls.
   MapLayer *addLayer(const char *name, uint16_t subsampling = 0);
 
+  /// Interleave the voxels of the named @p member_layers into a single group layer called @p name .
+  ///
+  /// Layers which are always accessed together, such as occupancy and @c VoxelMean , cost a cache miss each per voxel
+  /// when stored separately. A layer group stores the voxels of its members interleaved (array of structures) in the
+  /// group layer, so they share cache lines. The member layers remain in the layout with their existing indices and
+  /// @c VoxelLayout , but are flagged @c MapLayer::kGroupMember and have no storage of their own. @c Voxel ,
+  /// @c VoxelBuffer and @c VoxelSet access to members is resolved to the group layer transparently using
+  /// @c MapLayer::groupOffset() and @c MapLayer::voxelStride() . Code accessing the raw layer memory must do likewise.
+  ///
+  /// The group layer @c VoxelLayout has each member layer's data members, named `<layer>.<member>` . The group layer
+  /// is serialised while the members are not.
+  ///
+  /// Member layers must exist, must not already be group members and must share the same subsampling.
+  ///
+  /// @param name The name of the new group layer.
+  /// @param member_layers Names of the layers to interleave.
+  /// @return The group layer, or null if a member layer is missing, already grouped or has different subsampling.
+  /// @throw std::runtime_error if a member layout cannot be reproduced at the same relative offsets within the group.
+  MapLayer *addLayerGroup(const char *name, const std::initializer_list<const char *> &member_layers);
+
+  /// Resolve the @c MapLayer::groupLayer() for each @c MapLayer::kGroupMember layer. Must be called after restoring
+  /// layer flags, such as after loading a layout. Members with no matching group layer are reverted to standalone
+  /// layers.
+  void resolveLayerGroups();
+
   /// Retrieve a layer by name (exact match). By iterative search.
   /// @param layer_name The name of the layer to search for.
   /// @return The first layer matching @p layerName or null if not found.
@@ -242,6 +267,10 @@ private:
   /// Cache all known layer indices such as @c meanLayer() .
   void cacheLayerIndices();
 
+  /// Remove all layers except for @p preserve_layers , also preserving the group layers of any group members.
+  /// @param preserve_layers Indices of the layers to preserve.
+  void filterLayerIndices(std::vector<unsigned> preserve_layers);
+
   MapLayoutDetail *imp_;
 };
 }  // namespace ohm
@@ -0,0 +1,102 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapMemoryAccounting.h"
+
+#include <algorithm>
+
+namespace ohm
+{
+// Out of class definition for ODR use under C++14.
+constexpr unsigned MapMemoryAccounting::kMaxLayers;
+
+
+MapMemoryAccounting::MapMemoryAccounting()
+{
+  for (unsigned i = 0; i < kMaxLayers; ++i)
+  {
+    uncompressed_bytes_[i] = 0u;
+    compressed_bytes_[i] = 0u;
+    gpu_bytes_[i] = 0u;
+  }
+}
+
+
+MapMemoryAccounting::~MapMemoryAccounting() = default;
+
+
+void MapMemoryAccounting::adjust(unsigned layer_index, std::ptrdiff_t uncompressed_delta,
+                                 std::ptrdiff_t compressed_delta)
+{
+  const unsigned index = counterIndex(layer_index);
+  // Unsigned wrap around applies negative deltas.
+  uncompressed_bytes_[index] += size_t(uncompressed_delta);
+  compressed_bytes_[index] += size_t(compressed_delta);
+  host_bytes_ += size_t(uncompressed_delta + compressed_delta);
+}
+
+
+void MapMemoryAccounting::setGpuBytes(const std::vector<size_t> &layer_gpu_bytes)
+{
+  std::array<size_t, kMaxLayers> gpu_bytes{};
+  for (size_t i = 0; i < layer_gpu_bytes.size(); ++i)
+  {
+    gpu_bytes[counterIndex(unsigned(i))] += layer_gpu_bytes[i];
+  }
+  for (unsigned i = 0; i < kMaxLayers; ++i)
+  {
+    gpu_bytes_[i] = gpu_bytes[i];
+  }
+}
+
+
+size_t MapMemoryAccounting::hostBytes() const
+{
+  return host_bytes_;
+}
+
+
+MapMemoryUsage MapMemoryAccounting::usage(unsigned layer_count) const
+{
+  MapMemoryUsage usage;
+  usage.layers.resize(std::min(layer_count, kMaxLayers));
+  for (unsigned i = 0; i < unsigned(usage.layers.size()); ++i)
+  {
+    LayerMemoryUsage &layer = usage.layers[i];
+    layer.uncompressed_bytes = uncompressed_bytes_[i];
+    layer.compressed_bytes = compressed_bytes_[i];
+    layer.gpu_bytes = gpu_bytes_[i];
+    usage.uncompressed_bytes += layer.uncompressed_bytes;
+    usage.compressed_bytes += layer.compressed_bytes;
+    usage.gpu_bytes += layer.gpu_bytes;
+  }
+  return usage;
+}
+
+
+size_t MapMemoryAccounting::budget() const
+{
+  return budget_;
+}
+
+
+void MapMemoryAccounting::setBudget(size_t budget)
+{
+  budget_ = budget;
+}
+
+
+bool MapMemoryAccounting::overBudget() const
+{
+  const size_t budget = budget_;
+  return budget && host_bytes_ > budget;
+}
+
+
+unsigned MapMemoryAccounting::counterIndex(unsigned layer_index)
+{
+  return std::min(layer_index, kMaxLayers - 1u);
+}
+}  // namespace ohm
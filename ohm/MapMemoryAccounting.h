@@ -0,0 +1,124 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPMEMORYACCOUNTING_H
+#define OHM_MAPMEMORYACCOUNTING_H
+
+#include "OhmConfig.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct MapMemoryUsage;
+
+/// Function invoked by @c OccupancyMap::enforceMemoryBudget() when the map remains over its memory budget after
+/// compression. The function should reduce the map memory, such as by paging or culling regions. The @c MapMemoryUsage
+/// is the usage after compression.
+using MemoryBudgetFunction = std::function<void(OccupancyMap &, const MapMemoryUsage &)>;
+
+/// Memory usage of a single @c MapLayer as reported by @c MapMemoryAccounting::usage() .
+struct ohm_API LayerMemoryUsage
+{
+  /// Bytes of uncompressed voxel memory held by the layer's @c VoxelBlock objects.
+  size_t uncompressed_bytes = 0;
+  /// Bytes of compressed voxel memory, including uniform block fill values.
+  size_t compressed_bytes = 0;
+  /// Bytes of GPU memory caching the layer, as last reported by the @c GpuCache .
+  size_t gpu_bytes = 0;
+};
+
+/// Memory usage of an @c OccupancyMap as reported by @c MapMemoryAccounting::usage() .
+struct ohm_API MapMemoryUsage
+{
+  /// Per layer usage, indexed by @c MapLayer::layerIndex() .
+  std::vector<LayerMemoryUsage> layers;
+  /// Sum of @c LayerMemoryUsage::uncompressed_bytes for all layers.
+  size_t uncompressed_bytes = 0;
+  /// Sum of @c LayerMemoryUsage::compressed_bytes for all layers.
+  size_t compressed_bytes = 0;
+  /// Sum of @c LayerMemoryUsage::gpu_bytes for all layers.
+  size_t gpu_bytes = 0;
+
+  /// Query the host memory used for voxel data: uncompressed and compressed.
+  /// @return The host voxel memory (bytes).
+  inline size_t hostBytes() const { return uncompressed_bytes + compressed_bytes; }
+};
+
+/// Live accounting of the voxel memory used by a single @c OccupancyMap .
+///
+/// Each @c VoxelBlock reports changes in its uncompressed and compressed memory as it is allocated, compressed,
+/// uncompressed and released, while the @c GpuCache reports the GPU memory used for each layer. Counters are atomic so
+/// the accounting is updated from the compression thread without locking. Memory held by the @c VoxelMemoryPool for
+/// recycling is not included; see @c VoxelMemoryPool::stats() .
+///
+/// The accounting also holds the map memory budget used by @c OccupancyMap::enforceMemoryBudget() . The budget
+/// applies to @c MapMemoryUsage::hostBytes() ; GPU memory is budgeted by the @c GpuMemoryArbiter .
+///
+/// Each @c OccupancyMap owns an accounting object shared with its @c VoxelBlock objects.
+/// See @c OccupancyMap::memoryAccounting() .
+class ohm_API MapMemoryAccounting
+{
+public:
+  /// Number of layers tracked individually. Usage for layers with higher indices is accumulated in the last layer.
+  static constexpr unsigned kMaxLayers = 32u;
+
+  /// Constructor.
+  MapMemoryAccounting();
+  /// Destructor.
+  ~MapMemoryAccounting();
+
+  MapMemoryAccounting(const MapMemoryAccounting &) = delete;
+  MapMemoryAccounting &operator=(const MapMemoryAccounting &) = delete;
+
+  /// Adjust the host memory usage for a layer. For use by @c VoxelBlock .
+  /// @param layer_index The layer of interest.
+  /// @param uncompressed_delta The change in uncompressed bytes.
+  /// @param compressed_delta The change in compressed bytes.
+  void adjust(unsigned layer_index, std::ptrdiff_t uncompressed_delta, std::ptrdiff_t compressed_delta);
+
+  /// Set the GPU memory usage for all layers, replacing any previously reported values. For use by the @c GpuCache .
+  /// @param layer_gpu_bytes GPU bytes for each layer, indexed by layer index. Missing layers are set to zero.
+  void setGpuBytes(const std::vector<size_t> &layer_gpu_bytes);
+
+  /// Query the total uncompressed and compressed host memory. This is cheaper than @c usage() .
+  /// @return The host voxel memory (bytes).
+  size_t hostBytes() const;
+
+  /// Report the memory usage for each layer.
+  /// @param layer_count The number of layers to report. Limited to @c kMaxLayers .
+  /// @return The current usage.
+  MapMemoryUsage usage(unsigned layer_count) const;
+
+  /// Query the host memory budget. Zero when there is no budget.
+  /// @return The memory budget (bytes).
+  size_t budget() const;
+
+  /// Set the host memory budget.
+  /// @param budget The memory budget (bytes). Zero disables the budget.
+  void setBudget(size_t budget);
+
+  /// Query if the @c hostBytes() exceed a non-zero @c budget() .
+  /// @return True when over budget.
+  bool overBudget() const;
+
+private:
+  /// Resolve the counter index for @p layer_index .
+  static unsigned counterIndex(unsigned layer_index);
+
+  std::array<std::atomic<size_t>, kMaxLayers> uncompressed_bytes_;
+  std::array<std::atomic<size_t>, kMaxLayers> compressed_bytes_;
+  std::array<std::atomic<size_t>, kMaxLayers> gpu_bytes_;
+  std::atomic<size_t> host_bytes_{ 0 };
+  std::atomic<size_t> budget_{ 0 };
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPMEMORYACCOUNTING_H
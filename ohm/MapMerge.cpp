@@ -0,0 +1,331 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapMerge.h"
+
+#include "CovarianceVoxel.h"
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "MapSerialise.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "Voxel.h"
+#include "VoxelMean.h"
+#include "VoxelOccupancy.h"
+
+#include <ohmutil/Profile.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace ohm
+{
+namespace
+{
+/// Parameters shared by all voxel merges for a map pair.
+struct MergeParams
+{
+  /// Rotation from the source to the destination frame.
+  glm::dmat3 rotation{ 1.0 };
+  /// Destination occupancy value range.
+  float min_value = 0;
+  float max_value = 0;
+  /// Destination values at or beyond these limits are locked by saturation.
+  float locked_min = 0;
+  float locked_max = 0;
+  /// Merge the @c VoxelMean layer?
+  bool merge_mean = false;
+  /// Merge the @c CovarianceVoxel layer? Requires @c merge_mean .
+  bool merge_covariance = false;
+};
+
+
+/// The voxel references for a merge. The source and destination voxels must be keyed before calling
+/// @c mergeVoxel() .
+struct MergeVoxels
+{
+  Voxel<const float> src_occupancy;
+  Voxel<const VoxelMean> src_mean;
+  Voxel<const CovarianceVoxel> src_covariance;
+  Voxel<float> dst_occupancy;
+  Voxel<VoxelMean> dst_mean;
+  Voxel<CovarianceVoxel> dst_covariance;
+
+  MergeVoxels(OccupancyMap &dst, const OccupancyMap &src, const MergeParams &params)
+    : src_occupancy(&src, src.layout().occupancyLayer())
+    , src_mean(&src, (params.merge_mean) ? src.layout().meanLayer() : -1)
+    , src_covariance(&src, (params.merge_covariance) ? src.layout().covarianceLayer() : -1)
+    , dst_occupancy(&dst, dst.layout().occupancyLayer())
+    , dst_mean(&dst, (params.merge_mean) ? dst.layout().meanLayer() : -1)
+    , dst_covariance(&dst, (params.merge_covariance) ? dst.layout().covarianceLayer() : -1)
+  {}
+
+  void setSourceKey(const Key &key, const MapChunk *chunk)
+  {
+    src_occupancy.setKey(key, chunk);
+    src_mean.setKey(key, chunk);
+    src_covariance.setKey(key, chunk);
+  }
+
+  void setDestinationKey(const Key &key, MapChunk *chunk)
+  {
+    dst_occupancy.setKey(key, chunk);
+    dst_mean.setKey(key, chunk);
+    dst_covariance.setKey(key, chunk);
+  }
+};
+
+
+/// Pack the lower triangular Cholesky factor of @p covariance into @p cov .
+void packCovariance(const glm::dmat3 &covariance, CovarianceVoxel *cov)
+{
+  // Clamp the diagonal terms to keep the factor real for near singular matrices.
+  const double l00 = std::sqrt(std::max(covariance[0][0], 0.0));
+  const double l10 = (l00 > 0) ? covariance[0][1] / l00 : 0.0;
+  const double l20 = (l00 > 0) ? covariance[0][2] / l00 : 0.0;
+  const double l11 = std::sqrt(std::max(covariance[1][1] - l10 * l10, 0.0));
+  const double l21 = (l11 > 0) ? (covariance[1][2] - l20 * l10) / l11 : 0.0;
+  const double l22 = std::sqrt(std::max(covariance[2][2] - l20 * l20 - l21 * l21, 0.0));
+  cov->trianglar_covariance[0] = float(l00);
+  cov->trianglar_covariance[1] = float(l10);
+  cov->trianglar_covariance[2] = float(l11);
+  cov->trianglar_covariance[3] = float(l20);
+  cov->trianglar_covariance[4] = float(l21);
+  cov->trianglar_covariance[5] = float(l22);  // NOLINT(readability-magic-numbers)
+}
+
+
+/// Merge the source voxel into the destination voxel of @p voxels .
+/// @param src_position The source voxel position in the destination frame. The voxel mean when available.
+void mergeVoxel(MergeVoxels &voxels, const MergeParams &params, const glm::dvec3 &src_position)
+{
+  float src_value;
+  float dst_value;
+  voxels.src_occupancy.read(&src_value);
+  voxels.dst_occupancy.read(&dst_value);
+
+  if (dst_value == unobservedOccupancyValue())
+  {
+    voxels.dst_occupancy.write(std::max(params.min_value, std::min(src_value, params.max_value)));
+  }
+  else if (params.locked_min < dst_value && dst_value < params.locked_max)
+  {
+    voxels.dst_occupancy.write(std::max(params.min_value, std::min(dst_value + src_value, params.max_value)));
+  }
+
+  if (!params.merge_mean)
+  {
+    return;
+  }
+
+  VoxelMean src_mean;
+  voxels.src_mean.read(&src_mean);
+  if (!src_mean.count)
+  {
+    return;
+  }
+
+  const OccupancyMap &dst_map = *voxels.dst_mean.map();
+  const double resolution = dst_map.resolution();
+  const glm::dvec3 dst_centre = dst_map.voxelCentreGlobal(voxels.dst_mean.key());
+  VoxelMean dst_mean;
+  voxels.dst_mean.read(&dst_mean);
+  const glm::dvec3 dst_position = position(dst_mean, dst_centre, resolution);
+  const double dst_count = double(dst_mean.count);
+  const double src_count = double(src_mean.count);
+  const double count = dst_count + src_count;
+
+  if (params.merge_covariance)
+  {
+    // Covariance of the union of the two sample sets, where each covariance is normalised by its sample count.
+    CovarianceVoxel src_cov;
+    voxels.src_covariance.read(&src_cov);
+    glm::dmat3 covariance = params.rotation * covarianceMatrix(&src_cov) * glm::transpose(params.rotation);
+    if (dst_mean.count)
+    {
+      CovarianceVoxel dst_cov;
+      voxels.dst_covariance.read(&dst_cov);
+      const glm::dvec3 separation = src_position - dst_position;
+      covariance = (dst_count * covarianceMatrix(&dst_cov) + src_count * covariance) / count +
+                   (dst_count * src_count / (count * count)) * glm::outerProduct(separation, separation);
+    }
+    CovarianceVoxel merged_cov;
+    packCovariance(covariance, &merged_cov);
+    voxels.dst_covariance.write(merged_cov);
+  }
+
+  const glm::dvec3 merged_position = (dst_position * dst_count + src_position * src_count) / count;
+  dst_mean.coord = subVoxelCoord(merged_position - dst_centre, resolution);
+  dst_mean.count = unsigned(std::min<uint64_t>(uint64_t(dst_mean.count) + src_mean.count,
+                                               std::numeric_limits<unsigned>::max()));
+  voxels.dst_mean.write(dst_mean);
+}
+
+
+/// Invoke @p visit for each observed voxel key in @p chunk .
+template <typename Func>
+void forEachObservedVoxel(const MapChunk &chunk, const OccupancyMap &map, Voxel<const float> &occupancy, Func &&visit)
+{
+  const glm::ivec3 region_dim = map.regionVoxelDimensions();
+  for (int z = 0; z < region_dim.z; ++z)
+  {
+    for (int y = 0; y < region_dim.y; ++y)
+    {
+      for (int x = 0; x < region_dim.x; ++x)
+      {
+        const Key key(chunk.region.coord, uint8_t(x), uint8_t(y), uint8_t(z));
+        occupancy.setKey(key, &chunk);
+        float value;
+        occupancy.read(&value);
+        if (value != unobservedOccupancyValue())
+        {
+          visit(key);
+        }
+      }
+    }
+  }
+}
+
+
+bool isAligned(const OccupancyMap &dst, const OccupancyMap &src, const glm::dmat4 &src_to_dst)
+{
+  return src.regionVoxelDimensions() == dst.regionVoxelDimensions() && src.origin() == dst.origin() &&
+         src_to_dst == glm::dmat4(1.0);
+}
+}  // namespace
+
+
+bool canMerge(const OccupancyMap &dst, const OccupancyMap &src)
+{
+  return &src != &dst && src.resolution() == dst.resolution() && src.layout().occupancyLayer() >= 0 &&
+         dst.layout().occupancyLayer() >= 0;
+}
+
+
+bool mergeMap(OccupancyMap &dst, const OccupancyMap &src, const glm::dmat4 &src_to_dst, bool use_threads)
+{
+  PROFILE(mergeMap);
+  if (!canMerge(dst, src))
+  {
+    return false;
+  }
+
+  MergeParams params;
+  params.rotation = glm::dmat3(src_to_dst);
+  params.min_value = dst.minVoxelValue();
+  params.max_value = dst.maxVoxelValue();
+  params.locked_min = dst.saturateAtMinValue() ? dst.minVoxelValue() : std::numeric_limits<float>::lowest();
+  params.locked_max = dst.saturateAtMaxValue() ? dst.maxVoxelValue() : std::numeric_limits<float>::max();
+  params.merge_mean = src.layout().meanLayer() >= 0 && dst.layout().meanLayer() >= 0;
+  params.merge_covariance =
+    params.merge_mean && src.layout().covarianceLayer() >= 0 && dst.layout().covarianceLayer() >= 0;
+
+  // Ensure paged out regions are considered.
+  src.pageInAllRegions();
+
+  std::vector<const MapChunk *> src_chunks;
+  src.enumerateRegions(src_chunks);
+
+  if (isAligned(dst, src, src_to_dst))
+  {
+    // Each source region maps to one destination region. Create the destination regions from this thread, then
+    // merge the region pairs in parallel.
+    std::vector<MapChunk *> dst_chunks(src_chunks.size());
+    for (size_t i = 0; i < src_chunks.size(); ++i)
+    {
+      dst_chunks[i] = dst.region(src_chunks[i]->region.coord, true);
+    }
+
+    parallelForEachRegion(
+      src_chunks,
+      [&dst, &src, &params, &dst_chunks](const MapChunk &src_chunk, size_t region_index, unsigned /*worker_index*/)  //
+      {
+        MergeVoxels voxels(dst, src, params);
+        MapChunk *dst_chunk = dst_chunks[region_index];
+        forEachObservedVoxel(src_chunk, src, voxels.src_occupancy, [&](const Key &key) {
+          voxels.setSourceKey(key, &src_chunk);
+          voxels.setDestinationKey(key, dst_chunk);
+          const glm::dvec3 src_position =
+            (params.merge_mean) ? positionUnsafe(voxels.src_mean) : src.voxelCentreGlobal(key);
+          mergeVoxel(voxels, params, src_position);
+        });
+      },
+      use_threads);
+    return true;
+  }
+
+  // Resample each source voxel into the destination frame. Destination voxels may receive multiple source voxels, so
+  // this is serial.
+  MergeVoxels voxels(dst, src, params);
+  for (const MapChunk *src_chunk : src_chunks)
+  {
+    forEachObservedVoxel(*src_chunk, src, voxels.src_occupancy, [&](const Key &key) {
+      voxels.setSourceKey(key, src_chunk);
+      const glm::dvec3 src_position = glm::dvec3(
+        src_to_dst *
+        glm::dvec4((params.merge_mean) ? positionUnsafe(voxels.src_mean) : src.voxelCentreGlobal(key), 1.0));
+      const Key dst_key = dst.voxelKey(src_position);
+      voxels.setDestinationKey(dst_key, dst.region(dst_key.regionKey(), true));
+      mergeVoxel(voxels, params, src_position);
+    });
+  }
+
+  return true;
+}
+
+
+int mergeMapFiles(const std::string &output, const std::vector<std::string> &inputs,
+                  const std::vector<glm::dmat4> &transforms, SerialiseProgress *progress, bool use_threads)
+{
+  if (inputs.empty() || (!transforms.empty() && transforms.size() != inputs.size()))
+  {
+    return kSeMergeMismatch;
+  }
+
+  if (progress)
+  {
+    progress->setTargetProgress(unsigned(inputs.size()));
+  }
+
+  // The merged map takes its settings from the first input.
+  OccupancyMap merged;
+  int err = loadHeader(inputs.front(), merged);
+  if (err)
+  {
+    return err;
+  }
+
+  for (size_t i = 0; i < inputs.size(); ++i)
+  {
+    if (progress && progress->quit())
+    {
+      break;
+    }
+
+    std::unique_ptr<OccupancyMap> input(new OccupancyMap);
+    err = load(inputs[i], *input);
+    if (err)
+    {
+      return err;
+    }
+
+    if (!mergeMap(merged, *input, (transforms.empty()) ? glm::dmat4(1.0) : transforms[i], use_threads))
+    {
+      return kSeMergeMismatch;
+    }
+
+    if (progress)
+    {
+      progress->incrementProgress();
+    }
+  }
+
+  return save(output, merged);
+}
+}  // namespace ohm
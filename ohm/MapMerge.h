@@ -0,0 +1,84 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPMERGE_H
+#define OHM_MAPMERGE_H
+
+#include "OhmConfig.h"
+
+#include <glm/mat4x4.hpp>
+
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+class SerialiseProgress;
+
+/// @defgroup mapmerge Map merging
+/// Fuse occupancy maps built independently, such as submaps from multiple agents, into a single map.
+///
+/// Each observed source voxel is fused with the corresponding destination voxel as follows:
+/// - Occupancy: log odds values are added, assuming independent observations, then clamped to the destination
+///   @c OccupancyMap::minVoxelValue() and @c OccupancyMap::maxVoxelValue() . Destination voxels locked at a saturation
+///   limit are not modified. Unobserved destination voxels take the source value.
+/// - @c VoxelMean : positions are combined as a mean weighted by the sample counts. Requires the mean layer in both
+///   maps.
+/// - @c CovarianceVoxel : the sample covariances are combined as for the union of the two sample sets, using the
+///   voxel means and sample counts. Requires the mean and covariance layers in both maps.
+///
+/// Other layers are not merged. Unobserved source voxels are ignored, so merging is commutative for the occupancy
+/// layer other than for clamping.
+
+/// @ingroup mapmerge
+/// Can @p src be merged into @p dst ? Both maps must have an occupancy layer and the same resolution. The merge is
+/// aligned - see @c mergeMap() - when the maps also share the region voxel dimensions and origin.
+/// @param dst The map to merge into.
+/// @param src The map to merge from.
+/// @return True if @p src can be merged into @p dst .
+bool ohm_API canMerge(const OccupancyMap &dst, const OccupancyMap &src);
+
+/// @ingroup mapmerge
+/// Merge the observed voxels of @p src into @p dst .
+///
+/// The @p src_to_dst transform maps points from the @p src map frame into the @p dst map frame. When this is the
+/// identity and the maps share region dimensions and origin, each source region maps to exactly one destination region
+/// and the regions are merged in parallel - see @c parallelForEachRegion() . Otherwise the merge is serial and each
+/// source voxel is resampled into the destination voxel containing its transformed position: the voxel mean when
+/// available, otherwise the voxel centre. Covariances are rotated into the destination frame. Resampling does not
+/// interpolate, so some destination voxels may be missed or receive more than one source voxel when rotating.
+///
+/// The destination map must not be modified concurrently. The source map is only read.
+///
+/// @param dst The map to merge into.
+/// @param src The map to merge from. Must not be @p dst .
+/// @param src_to_dst Rigid transform from the @p src frame to the @p dst frame.
+/// @param use_threads Allow aligned regions to be merged in parallel?
+/// @return False if @c canMerge() fails, in which case @p dst is unchanged.
+bool ohm_API mergeMap(OccupancyMap &dst, const OccupancyMap &src, const glm::dmat4 &src_to_dst = glm::dmat4(1.0),
+                      bool use_threads = true);
+
+/// @ingroup mapmerge
+/// Merge the map files @p inputs into a new map file at @p output .
+///
+/// The inputs are loaded and merged one at a time, so only the merged map and a single input are held in memory. The
+/// merged map takes the resolution, region dimensions, origin, layout and occupancy parameters of the first input
+/// and is saved with @c save() . The inputs may be in any format supported by @c load() .
+///
+/// @param output The output map file.
+/// @param inputs The map files to merge. Must not be empty.
+/// @param transforms Optional transforms from each input map frame into the output frame. Either empty, for identity
+///   transforms, or the same size as @p inputs .
+/// @param progress Optional progress tracking. The target progress is the number of inputs.
+/// @param use_threads Allow aligned regions to be merged in parallel?
+/// @return @c kSeOk on success, @c kSeMergeMismatch if an input cannot be merged - see @c canMerge() - or another
+///   @c SerialisationError code.
+int ohm_API mergeMapFiles(const std::string &output, const std::vector<std::string> &inputs,
+                          const std::vector<glm::dmat4> &transforms = {}, SerialiseProgress *progress = nullptr,
+                          bool use_threads = true);
+}  // namespace ohm
+
+#endif  // OHM_MAPMERGE_H
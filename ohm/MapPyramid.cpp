@@ -0,0 +1,341 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapPyramid.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "Voxel.h"
+#include "VoxelOccupancy.h"
+
+#include "private/MapPyramidDetail.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+namespace ohm
+{
+namespace
+{
+/// Create the coarse level maps for @p source .
+void createLevels(MapPyramidDetail &d, const OccupancyMap &source)
+{
+  const glm::u8vec3 region_dim = source.regionVoxelDimensions();
+  if (region_dim.x % 2 || region_dim.y % 2 || region_dim.z % 2)
+  {
+    throw std::runtime_error("MapPyramid requires even region voxel dimensions");
+  }
+
+  if (source.layout().occupancyLayer() < 0)
+  {
+    throw std::runtime_error("MapPyramid source map has no occupancy layer");
+  }
+
+  d.levels.clear();
+  double resolution = source.resolution();
+  for (unsigned i = 0; i < d.level_count; ++i)
+  {
+    resolution *= 2.0;
+    std::unique_ptr<OccupancyMap> level(new OccupancyMap(resolution, region_dim, MapFlag::kDefault));
+    level->setOrigin(source.origin());
+    level->setHitValue(source.hitValue());
+    level->setMissValue(source.missValue());
+    level->setOccupancyThresholdProbability(source.occupancyThresholdProbability());
+    level->setMinVoxelValue(source.minVoxelValue());
+    level->setMaxVoxelValue(source.maxVoxelValue());
+    level->setSaturateAtMinValue(source.saturateAtMinValue());
+    level->setSaturateAtMaxValue(source.saturateAtMaxValue());
+    d.levels.emplace_back(std::move(level));
+  }
+}
+
+
+/// Check the voxel boundaries of each coarse level still align with those of @p source . This may not hold after an
+/// @c OccupancyMap::rebaseOrigin() on @p source moves the origin by an odd number of coarse voxels.
+bool levelsAligned(const MapPyramidDetail &d, const OccupancyMap &source)
+{
+  for (const auto &level : d.levels)
+  {
+    const glm::dvec3 voxel_offset = (source.origin() - level->origin()) / level->resolution();
+    const glm::dvec3 misalignment = glm::abs(voxel_offset - glm::round(voxel_offset));
+    if (glm::any(glm::greaterThan(misalignment, glm::dvec3(1e-6))))  // NOLINT(readability-magic-numbers)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/// Pool the eight voxels of @p child covered by the voxel at @p key in @p coarse .
+/// @return True if any child voxel is observed, in which case @p value is set.
+bool poolVoxel(const OccupancyMap &coarse, const Key &key, Voxel<const float> &child_occupancy,
+               PyramidPooling pooling, float *value)
+{
+  const OccupancyMap &child = *child_occupancy.map();
+  const glm::dvec3 centre = coarse.voxelCentreGlobal(key);
+  const double offset = 0.5 * child.resolution();
+  float pooled = 0;
+  unsigned observed_count = 0;
+  for (int z = -1; z <= 1; z += 2)
+  {
+    for (int y = -1; y <= 1; y += 2)
+    {
+      for (int x = -1; x <= 1; x += 2)
+      {
+        child_occupancy.setKey(child.voxelKey(centre + offset * glm::dvec3(x, y, z)));
+        if (!child_occupancy.isValid())
+        {
+          continue;
+        }
+
+        float child_value;
+        child_occupancy.read(&child_value);
+        if (child_value == unobservedOccupancyValue())
+        {
+          continue;
+        }
+
+        pooled = (pooling == PyramidPooling::kMax) ?
+                   ((observed_count) ? std::max(pooled, child_value) : child_value) :
+                   pooled + child_value;
+        ++observed_count;
+      }
+    }
+  }
+
+  if (!observed_count)
+  {
+    return false;
+  }
+
+  *value = (pooling == PyramidPooling::kMax) ? pooled : pooled / float(observed_count);
+  return true;
+}
+
+
+/// Recalculate the voxels of @p coarse which overlap the source region spanning @p min_ext to @p max_ext , pooling
+/// from @p child . The @p inset is used to sample just inside the region bounds to avoid ambiguity on the voxel
+/// boundaries and must be less than the source map resolution.
+void poolRegion(OccupancyMap &coarse, const OccupancyMap &child, const glm::dvec3 &min_ext, const glm::dvec3 &max_ext,
+                double inset, PyramidPooling pooling)
+{
+  const Key min_key = coarse.voxelKey(min_ext + glm::dvec3(inset));
+  const Key max_key = coarse.voxelKey(max_ext - glm::dvec3(inset));
+  const glm::ivec3 range = coarse.rangeBetween(min_key, max_key);
+
+  Voxel<const float> child_occupancy(&child, child.layout().occupancyLayer());
+  Voxel<float> coarse_occupancy(&coarse, coarse.layout().occupancyLayer());
+  for (int z = 0; z <= range.z; ++z)
+  {
+    for (int y = 0; y <= range.y; ++y)
+    {
+      for (int x = 0; x <= range.x; ++x)
+      {
+        Key key = min_key;
+        coarse.moveKey(key, x, y, z);
+
+        float value = unobservedOccupancyValue();
+        const bool observed = poolVoxel(coarse, key, child_occupancy, pooling, &value);
+        // Only create coarse regions for observed voxels.
+        MapChunk *chunk = coarse.region(key.regionKey(), observed);
+        if (!chunk)
+        {
+          continue;
+        }
+
+        coarse_occupancy.setKey(key, chunk);
+        float current_value;
+        coarse_occupancy.read(&current_value);
+        // Skip unchanged voxels to avoid dirtying the coarse region.
+        if (current_value != value)
+        {
+          coarse_occupancy.write(value);
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+
+MapPyramid::MapPyramid(unsigned level_count, PyramidPooling pooling)
+  : imp_(new MapPyramidDetail)
+{
+  imp_->level_count = std::max(level_count, 1u);
+  imp_->pooling = pooling;
+}
+
+
+MapPyramid::~MapPyramid()
+{
+  delete imp_;
+  imp_ = nullptr;
+}
+
+
+unsigned MapPyramid::levelCount() const
+{
+  return imp()->level_count;
+}
+
+
+PyramidPooling MapPyramid::pooling() const
+{
+  return imp()->pooling;
+}
+
+
+const OccupancyMap *MapPyramid::level(unsigned level) const
+{
+  const MapPyramidDetail *d = imp();
+  if (level == 0 || level > d->levels.size())
+  {
+    return nullptr;
+  }
+  return d->levels[level - 1].get();
+}
+
+
+unsigned MapPyramid::levelForResolution(double resolution) const
+{
+  const MapPyramidDetail *d = imp();
+  unsigned selected = 0;
+  for (unsigned i = 0; i < d->levels.size(); ++i)
+  {
+    if (d->levels[i]->resolution() <= resolution)
+    {
+      selected = i + 1;
+    }
+  }
+  return selected;
+}
+
+
+size_t MapPyramid::pendingCount() const
+{
+  return imp()->pending.size();
+}
+
+
+uint64_t MapPyramid::lastStamp() const
+{
+  return imp()->last_stamp;
+}
+
+
+void MapPyramid::reset()
+{
+  MapPyramidDetail *d = imp();
+  d->levels.clear();
+  d->pending.clear();
+  d->last_stamp = 0;
+}
+
+
+bool MapPyramid::layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                                   std::vector<int> & /*write_layers*/) const
+{
+  const int occupancy_layer = layout.occupancyLayer();
+  if (occupancy_layer < 0)
+  {
+    return false;
+  }
+
+  read_layers.emplace_back(occupancy_layer);
+  return true;
+}
+
+
+int MapPyramid::update(OccupancyMap &map, double time_slice)
+{
+  using Clock = std::chrono::high_resolution_clock;
+  const auto start_time = Clock::now();
+  const auto time_expired = [start_time, time_slice]() {
+    if (time_slice <= 0)
+    {
+      return false;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time);
+    return elapsed.count() >= time_slice;
+  };
+
+  MapPyramidDetail *d = imp();
+
+  const glm::dvec3 rebase_offset = map.rebaseOffset();
+  if (d->levels.empty())
+  {
+    createLevels(*d, map);
+    d->pending.clear();
+    d->last_stamp = 0;
+  }
+  else if (rebase_offset != d->rebase_offset)
+  {
+    // The source map has been rebased, invalidating the pending region keys. The rebase dirties every re-keyed region
+    // so they are collected again below.
+    d->pending.clear();
+    if (!levelsAligned(*d, map))
+    {
+      createLevels(*d, map);
+      d->last_stamp = 0;
+    }
+  }
+  d->rebase_offset = rebase_offset;
+
+  // Queue the regions changed since the last collection. Take the stamp first so changes made during collection are
+  // collected again next time.
+  const uint64_t stamp = map.stamp();
+  std::vector<std::pair<uint64_t, glm::i16vec3>> dirty_regions;
+  map.collectDirtyRegions(d->last_stamp, dirty_regions);
+  d->last_stamp = stamp;
+  for (const auto &dirty : dirty_regions)
+  {
+    d->pending.push(dirty.second);
+  }
+
+  if (hasReferencePosition())
+  {
+    d->pending.setReferencePosition(referencePosition());
+  }
+  else
+  {
+    d->pending.clearReferencePosition();
+  }
+
+  const double inset = 0.25 * map.resolution();
+  glm::i16vec3 region_key;
+  while (!time_expired() && d->pending.pop(map, &region_key))
+  {
+    const glm::dvec3 min_ext = map.regionSpatialMin(region_key);
+    const glm::dvec3 max_ext = map.regionSpatialMax(region_key);
+    const OccupancyMap *child = &map;
+    for (auto &level : d->levels)
+    {
+      poolRegion(*level, *child, min_ext, max_ext, inset, d->pooling);
+      child = level.get();
+    }
+  }
+
+  return (d->pending.empty()) ? kMprUpToDate : kMprProgressing;
+}
+
+
+MapPyramidDetail *MapPyramid::imp()
+{
+  return imp_;
+}
+
+
+const MapPyramidDetail *MapPyramid::imp() const
+{
+  return imp_;
+}
+}  // namespace ohm
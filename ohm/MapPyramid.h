@@ -0,0 +1,125 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPPYRAMID_H
+#define OHM_MAPPYRAMID_H
+
+#include "OhmConfig.h"
+
+#include "MappingProcess.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ohm
+{
+class OccupancyMap;
+struct MapPyramidDetail;
+
+/// Pooling operations used to derive a @c MapPyramid level voxel from the eight voxels it covers in the level below.
+enum class PyramidPooling : unsigned
+{
+  /// Use the maximum occupancy value of the observed child voxels. Conservative: a coarse voxel is occupied if any of
+  /// its children are occupied.
+  kMax,
+  /// Use the mean occupancy value of the observed child voxels.
+  kMean
+};
+
+/// A mapping process which maintains a hierarchy of coarse occupancy maps derived from a fine map.
+///
+/// Each level halves the resolution of the level below: level 1 has twice the voxel size of the source map, level 2
+/// four times and so on. The coarse maps share the source map origin, region voxel dimensions and occupancy
+/// parameters, so each coarse voxel exactly covers eight voxels of the level below. Those eight voxels are pooled
+/// into the coarse voxel as described by @c PyramidPooling . Unobserved child voxels are ignored and a coarse voxel is
+/// only observed once one of its children is observed.
+///
+/// Levels are created on the first @c update() and updated incrementally. Each @c update() collects the source map
+/// regions dirtied since the last @c update() - see @c OccupancyMap::collectDirtyRegions() - and recalculates the
+/// coarse voxels covering those regions in every level. Regions nearest the @c referencePosition() are updated first
+/// and any regions outstanding when the time slice expires are carried to the next @c update() .
+///
+/// Removing source map regions does not clear the coarse levels, which retain the last pooled values. This suits
+/// maintaining a global coarse map from a local fine map.
+///
+/// An @c OccupancyMap::rebaseOrigin() on the source map is detected on the next @c update() via
+/// @c OccupancyMap::rebaseOffset() . The pending regions are discarded and the re-keyed source regions are collected
+/// again. The coarse levels keep their origin, so their keys are unaffected, unless the rebase breaks the voxel
+/// alignment between levels, in which case the levels are rebuilt in full.
+///
+/// Only the occupancy layer is pooled. The coarse maps may be used with any query which takes an @c OccupancyMap ,
+/// such as for global planning, without re-integrating rays at the coarse resolution. Use @c levelForResolution() to
+/// select a level. The coarse maps must not be modified other than by this process.
+///
+/// The source map region voxel dimensions must be even along each axis so that voxel boundaries align between
+/// levels.
+class ohm_API MapPyramid : public MappingProcess
+{
+public:
+  /// Constructor.
+  /// @param level_count Number of coarse levels to maintain. Must be at least 1.
+  /// @param pooling The pooling operation used to derive coarse voxels.
+  explicit MapPyramid(unsigned level_count = 3, PyramidPooling pooling = PyramidPooling::kMax);
+
+  /// Destructor.
+  ~MapPyramid() override;
+
+  /// Query the number of coarse levels.
+  /// @return The coarse level count.
+  unsigned levelCount() const;
+
+  /// Query the pooling operation.
+  /// @return The pooling operation.
+  PyramidPooling pooling() const;
+
+  /// Access the map at the given level. Level zero is the source map, which is not held by this class, so this
+  /// returns null for level zero. Levels are null before the first @c update() .
+  /// @param level The level to access, in the range [1, levelCount()] .
+  /// @return The map for @p level or null when out of range or not yet created.
+  const OccupancyMap *level(unsigned level) const;
+
+  /// Select the coarsest level with a voxel resolution no larger than @p resolution .
+  /// @param resolution The desired maximum voxel size.
+  /// @return The level index in the range [0, levelCount()] . Zero selects the source map.
+  unsigned levelForResolution(double resolution) const;
+
+  /// Query the number of source regions awaiting an update.
+  /// @return The pending region count.
+  size_t pendingCount() const;
+
+  /// Query the source map stamp at which dirty regions were last collected.
+  /// @return The last collected stamp.
+  uint64_t lastStamp() const;
+
+  /// Releases the coarse maps and any pending regions. They are rebuilt in full on the next @c update() .
+  void reset() override;
+
+  /// Declares a read dependency on the occupancy layer. The process does not write to the source map.
+  bool layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                         std::vector<int> &write_layers) const override;
+
+  /// Update the coarse levels for regions changed in @p map .
+  ///
+  /// Throws a @c std::runtime_error if @p map region voxel dimensions are not even, or @p map has no occupancy layer.
+  ///
+  /// @param map The source map. Must be the same map for every call until @c reset() .
+  /// @param time_slice The amount of time available for processing (seconds). Zero or negative for no limit.
+  /// @return @c kMprUpToDate once all changed regions have been pooled, @c kMprProgressing otherwise.
+  int update(OccupancyMap &map, double time_slice) override;
+
+protected:
+  /// Internal data access
+  /// @return The internal data members.
+  MapPyramidDetail *imp();
+  /// Internal data access
+  /// @return The internal data members.
+  const MapPyramidDetail *imp() const;
+
+private:
+  MapPyramidDetail *imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPPYRAMID_H
@@ -5,6 +5,7 @@
 // Author: Kazys Stepanas
 #include "MapSerialise.h"
 
+#include "Aabb.h"
 #include "DefaultLayer.h"
 #include "MapChunk.h"
 #include "MapFlag.h"
@@ -16,6 +17,8 @@
 #include "VoxelBuffer.h"
 #include "VoxelLayout.h"
 
+#include "private/IndexedMapFile.h"
+#include "private/MapJournal.h"
 #include "private/OccupancyMapDetail.h"
 #include "private/SerialiseUtil.h"
 
@@ -23,8 +26,11 @@
 #include "serialise/MapSerialiseV0.2.h"
 #include "serialise/MapSerialiseV0.4.h"
 #include "serialise/MapSerialiseV0.5.h"
+#include "serialise/MapSerialiseV0.6.h"
 #include "serialise/MapSerialiseV0.h"
 
+#include <ohmutil/Profile.h>
+
 #include <glm/glm.hpp>
 
 #include <array>
@@ -32,9 +38,11 @@
 #include <cstring>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <type_traits>
+#include <unordered_set>
 #include <vector>
 
 #include <zlib.h>
@@ -59,6 +67,10 @@ std::map<int, std::string> s_error_codes = { makeErrorCode(ohm::kSeOk, "ok"),
                                              makeErrorCode(ohm::kSeUnknownDataType, "unknown data type"),
                                              makeErrorCode(ohm::kSeUnsupportedVersion, "unsupported version"),
                                              makeErrorCode(ohm::kSeDeprecatedVersion, "deprecated version"),
+                                             makeErrorCode(ohm::kSeJournalMismatch, "journal mismatch"),
+                                             makeErrorCode(ohm::kSeJournalCorrupt, "journal corrupt"),
+                                             makeErrorCode(ohm::kSeMergeMismatch, "merge mismatch"),
+                                             makeErrorCode(ohm::kSeVerifyFailure, "verify failure"),
                                              makeErrorCode(ohm::kSeExtensionCode, "unknown extension error") };
 }  // namespace
 
@@ -89,8 +101,9 @@ const uint32_t kMapHeaderMarker = 0x44330011u;
 // - MMM is a three digit specification of the current minor version.
 // - PPP is a three digit specification of the current patch version.
 const MapVersion kSupportedVersionMin = { 0, 0, 0 };
-const MapVersion kSupportedVersionMax = { 0, 5, 0 };
+const MapVersion kSupportedVersionMax = { 0, 6, 0 };
 const MapVersion kCurrentVersion = { 0, 5, 0 };
+const MapVersion kIndexedVersion = { 0, 6, 0 };
 
 // Note: version 0.3.x is not supported.
 
@@ -284,13 +297,13 @@ int saveMapInfo(OutputStream &stream, const MapInfo &map_info)
 }
 
 
-int saveHeader(OutputStream &stream, const OccupancyMapDetail &map)
+int saveHeader(OutputStream &stream, const OccupancyMapDetail &map, const MapVersion &map_version = kCurrentVersion)
 {
   bool ok = true;
   // Header marker + version
   HeaderVersion version;
   version.marker = kMapHeaderMarker;
-  version.version = kCurrentVersion;
+  version.version = map_version;
 
   ok = writeUncompressed<uint32_t>(stream, version.marker) && ok;
   ok = writeUncompressed<uint32_t>(stream, version.version.major) && ok;
@@ -317,7 +330,7 @@ int saveHeader(OutputStream &stream, const OccupancyMapDetail &map)
 
   // Added v0.3.0
   // Saving the map stamp has become important to ensure MapChunk::touched_stamps are correctly maintained.
-  ok = writeUncompressed<uint64_t>(stream, map.stamp) && ok;
+  ok = writeUncompressed<uint64_t>(stream, map.stamp.load()) && ok;
 
   // Add v0.3.2
   ok = writeUncompressed<uint32_t>(stream, std::underlying_type_t<MapFlag>(map.flags)) && ok;
@@ -402,13 +415,13 @@ int saveChunk(OutputStream &stream, const MapChunk &chunk, const OccupancyMapDet
   {
     const MapLayer &layer = layout.layer(i);
 
-    if (layer.flags() & MapLayer::kSkipSerialise)
+    if (layer.flags() & (MapLayer::kSkipSerialise | MapLayer::kGroupMember))
     {
-      // Not to be serialised.
+      // Not to be serialised. Group members are serialised with the group layer.
       continue;
     }
 
-    uint64_t layer_touched_stamp = chunk.touched_stamps[i];
+    uint64_t layer_touched_stamp = chunk.layerTouchedStamp(unsigned(i));
     ok = write<uint64_t>(stream, layer_touched_stamp) && ok;
 
     // Get the layer memory.
@@ -486,6 +499,7 @@ int loadHeader(InputStream &stream, HeaderVersion &version, OccupancyMapDetail &
   ok = readRaw<int32_t>(stream, map.region_voxel_dimensions.x) && ok;
   ok = readRaw<int32_t>(stream, map.region_voxel_dimensions.y) && ok;
   ok = readRaw<int32_t>(stream, map.region_voxel_dimensions.z) && ok;
+  map.region_indexer = RegionIndexer(map.region_voxel_dimensions);
   ok = readRaw<double>(stream, map.resolution) && ok;
   ok = readRaw<double>(stream, map.occupancy_threshold_value) && ok;
   ok = readRaw<double>(stream, map.hit_value) && ok;
@@ -503,16 +517,24 @@ int loadHeader(InputStream &stream, HeaderVersion &version, OccupancyMapDetail &
   if (version.version.major > 0 || version.version.major == 0 && version.version.minor >= 3)
   {
     // Read the map stamp.
-    ok = readRaw<uint64_t>(stream, map.stamp) && ok;
+    uint64_t stamp = 0;
+    ok = readRaw<uint64_t>(stream, stamp) && ok;
+    map.stamp = stamp;
   }
 
   // v0.3.2 added serialisation of map flags
   if (version.version.major > 0 || version.version.minor > 3 ||
       version.version.minor == 3 && version.version.patch >= 2)
   {
-    uint32_t flags = 0;
-    ok = readRaw<std::underlying_type_t<MapFlag>>(stream, map.flags) && ok;
-    map.flags = static_cast<MapFlag>(flags);
+    std::underlying_type_t<MapFlag> flags = 0;
+    ok = readRaw<std::underlying_type_t<MapFlag>>(stream, flags) && ok;
+    // Only the voxel order is restored from the flags. It cannot be inferred from the layout, while the layer flags are
+    // corrected once the layout is loaded.
+    map.flags = static_cast<MapFlag>(flags) & kVoxelOrderFlags;
+    if (!voxelOrderSupported(voxelOrderFromFlags(map.flags), glm::ivec3(map.region_voxel_dimensions)))
+    {
+      map.flags = MapFlag::kNone;
+    }
   }
   else
   {
@@ -548,6 +570,12 @@ int loadChunk(InputStream &stream, MapChunk &chunk, const OccupancyMapDetail &de
     for (size_t i = 0; i < layout.layerCount(); ++i)
     {
       const MapLayer &layer = layout.layer(i);
+      if (layer.isGroupMember())
+      {
+        // Loaded with the group layer.
+        continue;
+      }
+
       VoxelBuffer<VoxelBlock> voxel_buffer(chunk.voxel_blocks[i]);
       uint8_t *layer_mem = voxel_buffer.voxelMemory();
 
@@ -574,6 +602,42 @@ int loadChunk(InputStream &stream, MapChunk &chunk, const OccupancyMapDetail &de
 }
 
 
+/// Apply the filters of the partial @c load() after loading all regions from a format without a region index.
+/// Removes the chunks rejected by @p chunk_filter and clears the layers not selected in @p load_layers .
+void filterLoadedRegions(OccupancyMapDetail &detail, const CopyChunkFilter &chunk_filter,
+                         const std::vector<bool> &load_layers)
+{
+  const MapLayout &layout = detail.layout;
+  auto region_iter = detail.chunks.begin();
+  while (region_iter != detail.chunks.end())
+  {
+    MapChunk *chunk = region_iter->second;
+    if (chunk_filter && !chunk_filter(*chunk))
+    {
+      region_iter = detail.chunks.erase(region_iter);
+      delete chunk;
+      continue;
+    }
+
+    for (size_t i = 0; i < load_layers.size(); ++i)
+    {
+      const MapLayer &layer = layout.layer(i);
+      if (!load_layers[i] && !layer.isGroupMember())
+      {
+        VoxelBuffer<VoxelBlock> voxel_buffer(chunk->voxel_blocks[i]);
+        layer.clear(voxel_buffer.voxelMemory(), detail.region_voxel_dimensions);
+      }
+    }
+
+    if (!load_layers.empty())
+    {
+      chunk->searchAndUpdateFirstValid(detail.region_voxel_dimensions);
+    }
+    ++region_iter;
+  }
+}
+
+
 const char *serialiseErrorCodeString(int err)
 {
   std::unique_lock<std::mutex> guard(s_error_code_lock);
@@ -595,6 +659,10 @@ void registerSerialiseExtensionErrorCodeString(int err, const char *error_string
 
 int save(const std::string &filename, const OccupancyMap &map, SerialiseProgress *progress)
 {
+  PROFILE(MapSerialise_save);
+  // Ensure all regions of an indexed map are present before opening the file, which may be the mapped file.
+  map.pageInAllRegions();
+
   OutputStream stream(filename, kSfCompress);
   const OccupancyMapDetail &detail = *map.detail();
 
@@ -650,8 +718,33 @@ int save(const std::string &filename, const OccupancyMap &map, SerialiseProgress
 }
 
 
+std::future<int> saveAsync(const std::string &filename, const OccupancyMap &map, SerialiseProgress *progress)
+{
+  PROFILE(MapSerialise_saveAsync);
+  // Snapshot on the calling thread. The clone does not carry the map info or first ray time, which save() writes.
+  std::shared_ptr<OccupancyMap> snapshot(map.clone());
+  snapshot->detail()->info = map.detail()->info;
+  snapshot->detail()->first_ray_time = map.detail()->first_ray_time;
+
+  return std::async(std::launch::async,
+                    [filename, snapshot, progress]() { return save(filename, *snapshot, progress); });
+}
+
+
 int load(const std::string &filename, OccupancyMap &map, SerialiseProgress *progress, MapVersion *version_out)
 {
+  return load(filename, map, CopyChunkFilter(), CopyLayerFilter(), progress, version_out);
+}
+
+
+/// Implements the @c load() overloads and @c loadLazy() . With @p defer_unselected layers rejected by the
+/// @p layer_filter are deferred rather than cleared. Only indexed files support deferred layers, so other formats
+/// load all layers in that case.
+int loadFiltered(const std::string &filename, OccupancyMap &map, const CopyChunkFilter &chunk_filter,
+                 const CopyLayerFilter &layer_filter, bool defer_unselected, SerialiseProgress *progress,
+                 MapVersion *version_out)
+{
+  PROFILE(MapSerialise_load);
   InputStream stream(filename, kSfCompress);
   OccupancyMapDetail &detail = *map.detail();
 
@@ -699,13 +792,61 @@ int load(const std::string &filename, OccupancyMap &map, SerialiseProgress *prog
     {
       err = v0_5::load(stream, detail, progress, version.version, region_count);
     }
+    else if (version.version.major == 0 && version.version.minor == 6)
+    {
+      // The indexed format selects regions and layers before loading them.
+      return v0_6::load(filename, stream, detail, progress, version.version, region_count, chunk_filter,
+                        layer_filter, defer_unselected);
+    }
+  }
+
+  const CopyLayerFilter &clear_layer_filter = (defer_unselected) ? CopyLayerFilter() : layer_filter;
+  if (!err && (chunk_filter || clear_layer_filter))
+  {
+    // Older formats have no region index. Filter after loading.
+    std::vector<bool> load_layers;
+    IndexedMapFile::selectLayers(detail.layout, clear_layer_filter, load_layers);
+    filterLoadedRegions(detail, chunk_filter, load_layers);
   }
 
   return err;
 }
 
 
-int loadHeader(const std::string &filename, OccupancyMap &map, MapVersion *version_out, size_t *region_count)
+int load(const std::string &filename, OccupancyMap &map, const CopyChunkFilter &chunk_filter,
+         const CopyLayerFilter &layer_filter, SerialiseProgress *progress, MapVersion *version_out)
+{
+  return loadFiltered(filename, map, chunk_filter, layer_filter, false, progress, version_out);
+}
+
+
+int load(const std::string &filename, OccupancyMap &map, const Aabb &bounds, const CopyLayerFilter &layer_filter,
+         SerialiseProgress *progress, MapVersion *version_out)
+{
+  return load(filename, map, copyFilterExtents(bounds.minExtents(), bounds.maxExtents()), layer_filter, progress,
+              version_out);
+}
+
+
+int load(const std::string &filename, OccupancyMap &map, const std::vector<glm::i16vec3> &regions,
+         const CopyLayerFilter &layer_filter, SerialiseProgress *progress, MapVersion *version_out)
+{
+  const std::unordered_set<glm::i16vec3, MapRegion::Hash> region_set(regions.begin(), regions.end());
+  const auto filter = [region_set](const MapChunk &chunk) { return region_set.count(chunk.region.coord) != 0; };
+  return load(filename, map, filter, layer_filter, progress, version_out);
+}
+
+
+int loadLazy(const std::string &filename, OccupancyMap &map, const CopyLayerFilter &eager_layer_filter,
+             SerialiseProgress *progress, MapVersion *version_out)
+{
+  return loadFiltered(filename, map, CopyChunkFilter(), eager_layer_filter, true, progress, version_out);
+}
+
+
+/// Implements @c loadHeader() , optionally reporting the region index table offset of an indexed map file.
+int loadFileHeader(const std::string &filename, OccupancyMap &map, MapVersion *version_out, size_t *region_count,
+                   uint64_t *index_offset_out)
 {
   InputStream stream(filename, kSfCompress);
   OccupancyMapDetail &detail = *map.detail();
@@ -726,22 +867,32 @@ int loadHeader(const std::string &filename, OccupancyMap &map, MapVersion *versi
     *version_out = version.version;
   }
 
+  if (region_count)
+  {
+    *region_count = region_count_local;
+  }
+
   // From version 0.2 we have MapInfo.
   detail.info.clear();
-  if (version.version.major > 0 || version.version.minor > 1)
+  if (!err && version.version == kIndexedVersion)
   {
-    if (!err)
+    // The indexed format has an uncompressed preamble with the MapInfo and layout.
+    uint64_t index_offset = 0;
+    err = v0_6::loadPreamble(filename, stream.tell(), detail, index_offset);
+    if (index_offset_out)
     {
-      err = v0_2::loadMapInfo(stream, detail.info);
+      *index_offset_out = index_offset;
     }
   }
-
-  if (region_count)
+  else if (version.version.major > 0 || version.version.minor > 1)
   {
-    *region_count = region_count_local;
+    if (!err)
+    {
+      err = v0_2::loadMapInfo(stream, detail.info);
+    }
   }
 
-  if (!err)
+  if (!err && version.version != kIndexedVersion)
   {
     if (version.version.major == 0 && version.version.minor == 0 && version.version.patch == 0)
     {
@@ -766,9 +917,288 @@ int loadHeader(const std::string &filename, OccupancyMap &map, MapVersion *versi
     {
       detail.flags &= ~MapFlag::kVoxelMean;
     }
+
+    if (detail.layout.layerIndex(default_layer::occupancyGroupLayerName()) >= 0)
+    {
+      detail.flags |= MapFlag::kInterleavedLayers;
+    }
+    else
+    {
+      detail.flags &= ~MapFlag::kInterleavedLayers;
+    }
   }
 
   return err;
 }
 
+
+int loadHeader(const std::string &filename, OccupancyMap &map, MapVersion *version_out, size_t *region_count)
+{
+  return loadFileHeader(filename, map, version_out, region_count, nullptr);
+}
+
+
+int loadIndexSummary(const std::string &filename, OccupancyMap &map, IndexedMapSummary &summary,
+                     MapVersion *version_out)
+{
+  summary = IndexedMapSummary();
+
+  MapVersion version;
+  uint64_t index_offset = 0;
+  int err = loadFileHeader(filename, map, &version, nullptr, &index_offset);
+  if (version_out)
+  {
+    *version_out = version;
+  }
+
+  if (err)
+  {
+    return err;
+  }
+
+  if (version != kIndexedVersion)
+  {
+    return kSeUnsupportedVersion;
+  }
+
+  const OccupancyMapDetail &detail = *map.detail();
+  IndexedMapFile index;
+  err = index.open(filename, index_offset, detail);
+  if (err)
+  {
+    return err;
+  }
+
+  const std::vector<unsigned> &stored_layers = index.storedLayers();
+  summary.region_count = index.regionCount();
+  summary.layers.resize(stored_layers.size());
+  int occupancy_index = -1;
+  for (size_t i = 0; i < stored_layers.size(); ++i)
+  {
+    summary.layers[i].name = detail.layout.layer(stored_layers[i]).name();
+    occupancy_index = (int(stored_layers[i]) == detail.layout.occupancyLayer()) ? int(i) : occupancy_index;
+  }
+
+  if (occupancy_index >= 0)
+  {
+    summary.density_histogram.resize(IndexedMapSummary::kDensityBins);
+  }
+
+  const glm::dvec3 region_half_ext = 0.5 * detail.region_spatial_dimensions;
+  for (size_t r = 0; r < index.regionCount(); ++r)
+  {
+    const IndexedMapFile::RegionEntry &region = index.region(r);
+    if (r == 0)
+    {
+      summary.min_region = summary.max_region = region.coord;
+      summary.min_ext = region.centre - region_half_ext;
+      summary.max_ext = region.centre + region_half_ext;
+      summary.min_touched_time = summary.max_touched_time = region.touched_time;
+    }
+    else
+    {
+      summary.min_region = glm::min(summary.min_region, region.coord);
+      summary.max_region = glm::max(summary.max_region, region.coord);
+      summary.min_ext = glm::min(summary.min_ext, region.centre - region_half_ext);
+      summary.max_ext = glm::max(summary.max_ext, region.centre + region_half_ext);
+      summary.min_touched_time = std::min(summary.min_touched_time, region.touched_time);
+      summary.max_touched_time = std::max(summary.max_touched_time, region.touched_time);
+    }
+
+    for (size_t i = 0; i < stored_layers.size(); ++i)
+    {
+      const IndexedMapFile::LayerEntry &layer_entry = index.layer(r, i);
+      const uint64_t raw_size = detail.layout.layer(stored_layers[i]).layerByteSize(detail.region_voxel_dimensions);
+      IndexedLayerSummary &layer_summary = summary.layers[i];
+      layer_summary.raw_size += raw_size;
+      layer_summary.stored_size += layer_entry.stored_size;
+      layer_summary.compressed_count += (layer_entry.encoding != IndexedMapFile::kEncodingRaw);
+
+      if (int(i) == occupancy_index && raw_size)
+      {
+        const double ratio = double(layer_entry.stored_size) / double(raw_size);
+        const unsigned bin = unsigned(std::max(0.0, ratio) * IndexedMapSummary::kDensityBins);
+        ++summary.density_histogram[std::min<unsigned>(bin, IndexedMapSummary::kDensityBins - 1)];
+      }
+    }
+  }
+
+  return kSeOk;
+}
+
+
+int loadRegionIndex(const std::string &filename, OccupancyMap &map, IndexedRegionIndex &index, MapVersion *version_out)
+{
+  static_assert(unsigned(kIbeRaw) == unsigned(IndexedMapFile::kEncodingRaw), "Encoding mismatch");
+  static_assert(unsigned(kIbeZLib) == unsigned(IndexedMapFile::kEncodingZLib), "Encoding mismatch");
+  static_assert(unsigned(kIbeSparse) == unsigned(IndexedMapFile::kEncodingSparse), "Encoding mismatch");
+
+  index = IndexedRegionIndex();
+
+  MapVersion version;
+  uint64_t index_offset = 0;
+  int err = loadFileHeader(filename, map, &version, nullptr, &index_offset);
+  if (version_out)
+  {
+    *version_out = version;
+  }
+
+  if (err)
+  {
+    return err;
+  }
+
+  if (version != kIndexedVersion)
+  {
+    return kSeUnsupportedVersion;
+  }
+
+  const OccupancyMapDetail &detail = *map.detail();
+  IndexedMapFile file_index;
+  err = file_index.open(filename, index_offset, detail);
+  if (err)
+  {
+    return err;
+  }
+
+  const std::vector<unsigned> &stored_layers = file_index.storedLayers();
+  for (unsigned layer_index : stored_layers)
+  {
+    index.layers.emplace_back(detail.layout.layer(layer_index).name());
+  }
+
+  // Blobs follow the header, so the header ends at the first blob, or at the index table when there are no blobs.
+  index.header_size = index_offset;
+  index.regions.reserve(file_index.regionCount());
+  index.touched_times.reserve(file_index.regionCount());
+  index.blobs.reserve(file_index.regionCount() * stored_layers.size());
+  for (size_t r = 0; r < file_index.regionCount(); ++r)
+  {
+    const IndexedMapFile::RegionEntry &region = file_index.region(r);
+    index.regions.emplace_back(region.coord);
+    index.touched_times.emplace_back(region.touched_time);
+    for (size_t i = 0; i < stored_layers.size(); ++i)
+    {
+      const IndexedMapFile::LayerEntry &layer_entry = file_index.layer(r, i);
+      IndexedLayerBlob blob;
+      blob.touched_stamp = layer_entry.touched_stamp;
+      blob.offset = layer_entry.offset;
+      blob.stored_size = layer_entry.stored_size;
+      blob.encoding = layer_entry.encoding;
+      index.blobs.emplace_back(blob);
+      index.header_size = (blob.stored_size) ? std::min(index.header_size, blob.offset) : index.header_size;
+    }
+  }
+
+  return kSeOk;
+}
+
+int saveIndexed(const std::string &filename, const OccupancyMap &map, SerialiseProgress *progress, unsigned flags)
+{
+  PROFILE(MapSerialise_saveIndexed);
+  // Ensure all regions of an indexed map are present before opening the file, which may be the mapped file.
+  map.pageInAllRegions();
+
+  // The stream is uncompressed. Region layers are compressed independently.
+  OutputStream stream(filename);
+  const OccupancyMapDetail &detail = *map.detail();
+
+  if (!stream.isOpen())
+  {
+    return kSeFileCreateFailure;
+  }
+
+  if (progress)
+  {
+    progress->setTargetProgress(unsigned(detail.chunks.size()));
+  }
+
+  int err = saveHeader(stream, detail, kIndexedVersion);
+
+  if (err)
+  {
+    return err;
+  }
+
+  // Placeholder for the region index table offset. Updated once the regions are written.
+  const size_t index_offset_pos = stream.tell();
+  if (!writeUncompressed<uint64_t>(stream, 0u))
+  {
+    return kSeFileWriteFailure;
+  }
+
+  err = saveMapInfo(stream, detail.info);
+
+  if (err)
+  {
+    return err;
+  }
+
+  err = saveLayout(stream, detail);
+
+  if (err)
+  {
+    return err;
+  }
+
+  return IndexedMapFile::write(stream, detail, index_offset_pos, flags, progress);
+}
+
+
+int openIndexed(const std::string &filename, OccupancyMap &map, MapVersion *version_out)
+{
+  return openIndexed(filename, map, CopyLayerFilter(), version_out);
+}
+
+
+int openIndexed(const std::string &filename, OccupancyMap &map, const CopyLayerFilter &eager_layer_filter,
+                MapVersion *version_out)
+{
+  InputStream stream(filename, kSfCompress);
+  OccupancyMapDetail &detail = *map.detail();
+
+  if (!stream.isOpen())
+  {
+    return kSeFileOpenFailure;
+  }
+
+  map.clear();
+
+  // Header is read uncompressed.
+  size_t region_count = 0;
+  HeaderVersion version;
+  int err = loadHeader(stream, version, detail, region_count);
+  if (version_out)
+  {
+    *version_out = version.version;
+  }
+
+  if (err)
+  {
+    return err;
+  }
+
+  if (version.version != kIndexedVersion)
+  {
+    // Not an indexed map. Load in full.
+    stream.close();
+    return load(filename, map, nullptr, version_out);
+  }
+
+  return v0_6::open(filename, stream, detail, version.version, region_count, eager_layer_filter);
+}
+
+
+int saveDelta(const std::string &filename, const OccupancyMap &map, uint64_t from_stamp, SerialiseProgress *progress,
+              uint64_t *stamp_out)
+{
+  return MapJournal::append(filename, map, from_stamp, progress, stamp_out);
+}
+
+
+int loadDelta(const std::string &filename, OccupancyMap &map, SerialiseProgress *progress, uint64_t *stamp_out)
+{
+  return MapJournal::replay(filename, map, progress, stamp_out);
+}
+
 }  // namespace ohm
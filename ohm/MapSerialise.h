@@ -8,10 +8,15 @@
 
 #include "OhmConfig.h"
 
+#include "CopyUtil.h"
+
 #include <glm/fwd.hpp>
+#include <glm/vec3.hpp>
 
 #include <cinttypes>
+#include <future>
 #include <string>
+#include <vector>
 
 #ifdef major
 #undef major
@@ -25,6 +30,7 @@
 
 namespace ohm
 {
+class Aabb;
 class OccupancyMap;
 
 /// An enumeration of potential serialisation errors.
@@ -57,6 +63,15 @@ enum SerialisationError
   /// A previously supported version, but one which does not support upgrading.
   kSeDeprecatedVersion,
 
+  /// A map journal does not match the map resolution, region dimensions, origin, voxel order or layout.
+  kSeJournalMismatch,
+  /// A map journal has an incomplete or corrupt tail and cannot be appended to.
+  kSeJournalCorrupt,
+  /// Maps to be merged have mismatched resolutions or lack an occupancy layer.
+  kSeMergeMismatch,
+  /// A written map does not match the source map content. See @c upgradeMap() .
+  kSeVerifyFailure,
+
   kSeExtensionCode = 0x1000
 };
 
@@ -142,6 +157,121 @@ extern const MapVersion ohm_API kSupportedVersionMin;
 extern const MapVersion ohm_API kSupportedVersionMax;
 /// Current MapVersion version.
 extern const MapVersion ohm_API kCurrentVersion;
+/// Version number for the indexed, random access map format written by @c saveIndexed() .
+extern const MapVersion ohm_API kIndexedVersion;
+
+/// Flags for @c saveIndexed() .
+enum IndexedMapFlag : unsigned
+{
+  /// Write the region layer data raw. This yields larger files, but regions can be paged in with a single copy.
+  kImfRaw = 0u,
+  /// Independently zlib compress each region layer.
+  kImfCompress = (1u << 0u),
+  /// Encode regions in parallel using a thread pool. Requires @c OHM_FEATURE_THREADS , otherwise ignored.
+  kImfParallel = (1u << 1u),
+  /// Store sparse region layers as a bit mask of the voxels which differ from the layer default value plus the values
+  /// of only those voxels. Chosen per region layer when at most a quarter of the voxels differ from the default,
+  /// otherwise the layer is stored as for @c kImfCompress or @c kImfRaw . Sparse layers are not zlib compressed, so
+  /// disk size and load time are proportional to the observed content.
+  kImfSparse = (1u << 2u)
+};
+
+/// Per layer statistics from the region index of an indexed map file - see @c loadIndexSummary() .
+struct ohm_API IndexedLayerSummary
+{
+  /// The layer name.
+  std::string name;
+  /// Total uncompressed layer byte size over all regions.
+  uint64_t raw_size = 0;
+  /// Total stored layer byte size over all regions.
+  uint64_t stored_size = 0;
+  /// Number of regions storing the layer compressed.
+  size_t compressed_count = 0;
+};
+
+/// Map statistics gathered from the region index of an indexed map file, without loading any voxel data - see
+/// @c loadIndexSummary() .
+struct ohm_API IndexedMapSummary
+{
+  /// Number of bins in the @c density_histogram .
+  enum : unsigned
+  {
+    kDensityBins = 10
+  };
+
+  /// Number of regions in the file.
+  size_t region_count = 0;
+  /// Minimum region key. Only valid when @c region_count is non zero.
+  glm::i16vec3 min_region{ 0 };
+  /// Maximum region key. Only valid when @c region_count is non zero.
+  glm::i16vec3 max_region{ 0 };
+  /// Minimum spatial extents of the regions. This bounds the voxel extents to within a region.
+  glm::dvec3 min_ext{ 0 };
+  /// Maximum spatial extents of the regions. This bounds the voxel extents to within a region.
+  glm::dvec3 max_ext{ 0 };
+  /// Earliest @c MapChunk::touched_time .
+  double min_touched_time = 0;
+  /// Latest @c MapChunk::touched_time .
+  double max_touched_time = 0;
+  /// Statistics for each serialised layer.
+  std::vector<IndexedLayerSummary> layers;
+  /// A region density estimate: a histogram of the occupancy layer compression ratio of each region in
+  /// @c kDensityBins bins. Bin @c i counts regions where the stored size is in the range
+  /// `[i, i + 1) / kDensityBins` of the raw size, with the last bin including uncompressed regions. Sparse and
+  /// uniform regions compress well and fall in the lower bins. Empty when there is no occupancy layer.
+  std::vector<size_t> density_histogram;
+};
+
+/// Encodings of the layer blobs of an indexed map file - see @c IndexedLayerBlob .
+enum IndexedBlobEncoding : uint32_t
+{
+  /// Raw voxel data.
+  kIbeRaw = 0u,
+  /// Zlib compressed voxel data.
+  kIbeZLib = 1u,
+  /// Sparse voxel data: the voxels which differ from the layer default value. See @c kImfSparse .
+  kIbeSparse = 2u
+};
+
+/// The location of the blob storing one layer of one region in an indexed map file - see @c loadRegionIndex() .
+struct ohm_API IndexedLayerBlob
+{
+  /// @c MapChunk::touched_stamps for the layer when saved.
+  uint64_t touched_stamp = 0;
+  /// File offset of the blob (bytes).
+  uint64_t offset = 0;
+  /// Stored byte size of the blob.
+  uint64_t stored_size = 0;
+  /// The blob @c IndexedBlobEncoding .
+  uint32_t encoding = kIbeRaw;
+};
+
+/// The region index table of an indexed map file - see @c loadRegionIndex() .
+///
+/// This exposes the file location of each region layer blob so that blobs may be read or transferred as stored,
+/// without decoding, such as by a server sharing the regions of a map file.
+struct ohm_API IndexedRegionIndex
+{
+  /// Names of the layers stored for each region. Layers with @c MapLayer::kSkipSerialise are not stored.
+  std::vector<std::string> layers;
+  /// Region keys, in file order.
+  std::vector<glm::i16vec3> regions;
+  /// @c MapChunk::touched_time for each region.
+  std::vector<double> touched_times;
+  /// Layer blobs: @c layers.size() items for each region, in @c layers order.
+  std::vector<IndexedLayerBlob> blobs;
+  /// Byte size of the file content preceding the region blobs: the map header, @c MapInfo and @c MapLayout .
+  uint64_t header_size = 0;
+
+  /// Access the blob for @p layer of the region at @p region_index .
+  /// @param region_index Index into @c regions .
+  /// @param layer Index into @c layers .
+  /// @return The layer blob.
+  inline const IndexedLayerBlob &blob(size_t region_index, size_t layer) const
+  {
+    return blobs[region_index * layers.size() + layer];
+  }
+};
 
 /// Progress observer interface for serialisation.
 ///
@@ -193,6 +323,25 @@ void ohm_API registerSerialiseExtensionErrorCodeString(int err, const char *erro
 /// @return @c SE_OK on success, or a non zero @c SerialisationError on failure.
 int ohm_API save(const std::string &filename, const OccupancyMap &map, SerialiseProgress *progress = nullptr);
 
+/// Save @p map to @p filename on a background thread, allowing the map to be updated while saving.
+///
+/// A snapshot of @p map is taken before returning, then written by @c save() on a background thread. The snapshot is an
+/// @c OccupancyMap::clone() : compressed voxel blocks are shared with the snapshot by reference as compressed data are
+/// immutable, while uncompressed blocks are copied. The snapshot memory is released once saved. Maps created with
+/// @c MapFlag::kCompressed therefore snapshot most cheaply.
+///
+/// @p map must not be modified during this call, but may be modified - e.g., by @c RayMapper::integrateRays() - as soon
+/// as it returns. The file content reflects the map at the time of the call.
+///
+/// The @p progress object is invoked from the background thread and must remain valid until the save completes.
+///
+/// @param filename The name of the file to save to.
+/// @param map The map to save.
+/// @param progress Optional progress tracking object.
+/// @return A future yielding the @c save() result: @c SE_OK on success, or a non zero @c SerialisationError on failure.
+std::future<int> ohm_API saveAsync(const std::string &filename, const OccupancyMap &map,
+                                   SerialiseProgress *progress = nullptr);
+
 /// Load @p map from @p filename.
 ///
 /// This method loads an @c OccupancyMap from file. The progress may optionally be tracked by providing
@@ -209,6 +358,62 @@ int ohm_API save(const std::string &filename, const OccupancyMap &map, Serialise
 int ohm_API load(const std::string &filename, OccupancyMap &map, SerialiseProgress *progress = nullptr,
                  MapVersion *version_out = nullptr);
 
+/// Load a subset of the regions and layers of @p map from @p filename.
+///
+/// Only regions passing the @p chunk_filter are loaded and only layers passing the @p layer_filter contain voxel data.
+/// The @c MapLayout is always loaded in full, with the voxels of unselected layers cleared to their default values.
+/// An empty filter selects everything, so this matches @c load() when both filters are empty.
+///
+/// For an indexed map file ( @c kIndexedVersion ) the filters are evaluated against the region index table and
+/// rejected regions and layers are never read or decompressed. The @p chunk_filter is given a @c MapChunk with the
+/// region, touch time and stamps set, but no voxel data. For older formats the whole file is loaded, then rejected
+/// regions are removed and unselected layers cleared, so the @p chunk_filter may inspect voxel data, but the load
+/// cost is unchanged.
+///
+/// @param filename The name of the file to load from.
+/// @param map The map object to load into.
+/// @param chunk_filter Selects the regions to load. See @c copyFilterExtents() and related filters.
+/// @param layer_filter Selects the layers to load by name. A group member layer is loaded with its group layer, so
+///   selecting any layer of a group loads the whole group.
+/// @param progress Optional progress tracking object.
+/// @param[out] version_out When present, set to the version number of the loaded map format.
+/// @return @c SE_OK on success, or a non zero @c SerialisationError on failure.
+int ohm_API load(const std::string &filename, OccupancyMap &map, const CopyChunkFilter &chunk_filter,
+                 const CopyLayerFilter &layer_filter = CopyLayerFilter(), SerialiseProgress *progress = nullptr,
+                 MapVersion *version_out = nullptr);
+
+/// @overload
+///
+/// Load the regions of @p filename overlapping the axis aligned @p bounds .
+int ohm_API load(const std::string &filename, OccupancyMap &map, const Aabb &bounds,
+                 const CopyLayerFilter &layer_filter = CopyLayerFilter(), SerialiseProgress *progress = nullptr,
+                 MapVersion *version_out = nullptr);
+
+/// @overload
+///
+/// Load the regions of @p filename with keys in @p regions .
+int ohm_API load(const std::string &filename, OccupancyMap &map, const std::vector<glm::i16vec3> &regions,
+                 const CopyLayerFilter &layer_filter = CopyLayerFilter(), SerialiseProgress *progress = nullptr,
+                 MapVersion *version_out = nullptr);
+
+/// Load @p map from @p filename , loading only the layers passing @p eager_layer_filter immediately. The voxel data
+/// for other layers are loaded lazily, the first time each region's @c VoxelBlock for the layer is retained, such as
+/// by @c Voxel access.
+///
+/// This reduces load time and memory for consumers which only use some layers, such as the occupancy layer of a map
+/// with voxel mean and covariance layers, while keeping the full @c MapLayout available. Only indexed map files
+/// ( @c kIndexedVersion ) support lazy layers. Deferred layers keep the file memory mapped until every deferred block
+/// is loaded or released. Other formats are loaded in full, as for @c load() .
+///
+/// @param filename The name of the file to load from.
+/// @param map The map object to load into.
+/// @param eager_layer_filter Selects the layers to load immediately by name. All layers are loaded when empty.
+/// @param progress Optional progress tracking object.
+/// @param[out] version_out When present, set to the version number of the loaded map format.
+/// @return @c SE_OK on success, or a non zero @c SerialisationError on failure.
+int ohm_API loadLazy(const std::string &filename, OccupancyMap &map, const CopyLayerFilter &eager_layer_filter,
+                     SerialiseProgress *progress = nullptr, MapVersion *version_out = nullptr);
+
 /// Loads the header and layers of a map file without loading the chunks for voxel data.
 ///
 /// The resulting @p map contains no chunks or voxel data, but does contain valid @c MapLayout data.
@@ -223,6 +428,110 @@ int ohm_API load(const std::string &filename, OccupancyMap &map, SerialiseProgre
 /// @return @c SE_OK on success, or a non zero @c SerialisationError on failure.
 int ohm_API loadHeader(const std::string &filename, OccupancyMap &map, MapVersion *version_out = nullptr,
                        size_t *region_count = nullptr);
+
+/// Load the header of an indexed map file ( @c kIndexedVersion ) into @p map , as for @c loadHeader() , and summarise
+/// the regions from the region index table without loading any voxel data.
+///
+/// This supports fast inspection of large maps: the cost is proportional to the index table size rather than the
+/// voxel data size.
+///
+/// @param filename The name of the file to inspect.
+/// @param map The map object to load the header into.
+/// @param[out] summary The region index summary.
+/// @param[out] version_out When present, set to the version number of the map format.
+/// @return @c SE_OK on success, @c kSeUnsupportedVersion if the file is not an indexed map, or another non zero
+///   @c SerialisationError on failure.
+int ohm_API loadIndexSummary(const std::string &filename, OccupancyMap &map, IndexedMapSummary &summary,
+                             MapVersion *version_out = nullptr);
+
+/// Load the header of an indexed map file ( @c kIndexedVersion ) into @p map , as for @c loadHeader() , and read the
+/// region index table into @p index without loading any voxel data.
+///
+/// @param filename The name of the file to read.
+/// @param map The map object to load the header into.
+/// @param[out] index The region index.
+/// @param[out] version_out When present, set to the version number of the map format.
+/// @return @c SE_OK on success, @c kSeUnsupportedVersion if the file is not an indexed map, or another non zero
+///   @c SerialisationError on failure.
+int ohm_API loadRegionIndex(const std::string &filename, OccupancyMap &map, IndexedRegionIndex &index,
+                            MapVersion *version_out = nullptr);
+
+/// Save @p map to @p filename using the indexed map format ( @c kIndexedVersion ).
+///
+/// The indexed format stores an index table of regions where each region layer is stored as an independent blob,
+/// either raw or zlib compressed. This supports memory mapping the file and loading regions on demand via
+/// @c openIndexed() . The file may also be loaded in full using @c load() , which loads regions in parallel when
+/// @c OHM_FEATURE_THREADS is enabled.
+///
+/// Use @c kImfParallel to compress regions on a thread pool. Regions are still written in order and @p progress is
+/// only updated from the calling thread.
+///
+/// @param filename The name of the file to save to.
+/// @param map The map to save.
+/// @param progress Optional progress tracking object.
+/// @param flags @c IndexedMapFlag values controlling the region encoding.
+/// @return @c SE_OK on success, or a non zero @c SerialisationError on failure.
+int ohm_API saveIndexed(const std::string &filename, const OccupancyMap &map, SerialiseProgress *progress = nullptr,
+                        unsigned flags = kImfCompress);
+
+/// Open @p map from @p filename without loading the region voxel data.
+///
+/// For an indexed map file - see @c saveIndexed() - this loads the map header, layout and region index then memory
+/// maps the file. Regions are loaded on demand the first time they are requested via @c OccupancyMap::region() .
+/// Note that iteration of the map only visits regions which have been loaded. Use
+/// @c OccupancyMap::pageInAllRegions() to load all remaining regions.
+///
+/// For other map versions this is equivalent to @c load() .
+///
+/// The current content of @p map is overwritten by the loaded data.
+///
+/// @param filename The name of the file to open.
+/// @param map The map object to load into.
+/// @param[out] version_out When present, set to the version number of the loaded map format.
+/// @return @c SE_OK on success, or a non zero @c SerialisationError on failure.
+int ohm_API openIndexed(const std::string &filename, OccupancyMap &map, MapVersion *version_out = nullptr);
+
+/// @overload
+///
+/// Regions paged in from an indexed map file only load the layers passing @p eager_layer_filter . The other layers
+/// are loaded lazily on first access - see @c loadLazy() .
+int ohm_API openIndexed(const std::string &filename, OccupancyMap &map, const CopyLayerFilter &eager_layer_filter,
+                        MapVersion *version_out = nullptr);
+
+/// Append the regions of @p map changed since @p from_stamp to the map journal at @p filename , creating the journal
+/// if it does not exist.
+///
+/// This supports incremental checkpoints: save a base map with @c save() , then periodically call this function,
+/// passing the @p stamp_out from the previous call (or the @c OccupancyMap::stamp() at the base save) as
+/// @p from_stamp . Only regions with a @c MapChunk::dirty_stamp greater than @p from_stamp are written. Each call
+/// appends one delta which is committed only once completely written. Regions removed from the map are not recorded.
+///
+/// A journal left incomplete by an interrupted write is rejected with @c kSeJournalCorrupt . The journal must then be
+/// replaced, normally after saving a new base map.
+///
+/// @param filename The journal file path.
+/// @param map The map to save changes from.
+/// @param from_stamp Write regions changed after this map stamp.
+/// @param progress Optional progress tracking and early abort.
+/// @param[out] stamp_out Optionally set to the map stamp recorded for this delta.
+/// @return @c kSeOk on success, or a non zero @c SerialisationError code on failure.
+int ohm_API saveDelta(const std::string &filename, const OccupancyMap &map, uint64_t from_stamp,
+                      SerialiseProgress *progress = nullptr, uint64_t *stamp_out = nullptr);
+
+/// Replay the map journal at @p filename onto @p map , normally the base map loaded with @c load() .
+///
+/// Deltas are replayed in order, replacing the serialised layers of any recorded region. Replay stops at the last
+/// complete delta, so a journal truncated by an interrupted write is recovered up to that point. The map stamp is
+/// raised to the stamp of the last delta.
+///
+/// @param filename The journal file path.
+/// @param map The map to update. Must have the resolution, region dimensions, origin, voxel order and layout of the
+///   journalled map.
+/// @param progress Optional progress tracking and early abort.
+/// @param[out] stamp_out Optionally set to the map stamp of the last delta replayed, or zero when there are none.
+/// @return @c kSeOk on success, or a non zero @c SerialisationError code on failure.
+int ohm_API loadDelta(const std::string &filename, OccupancyMap &map, SerialiseProgress *progress = nullptr,
+                      uint64_t *stamp_out = nullptr);
 }  // namespace ohm
 
 #endif  // OHM_MAPSERIALISE_H
@@ -0,0 +1,634 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapSharedMemory.h"
+
+#include "MapChunk.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "MapRegion.h"
+#include "OccupancyMap.h"
+#include "VoxelBlock.h"
+#include "VoxelBuffer.h"
+
+#include "private/MapSharedMemoryDetail.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace ohm
+{
+using namespace sharedmap;
+
+namespace
+{
+/// Find the directory entry for @p packed .
+/// @return The entry index, or the directory capacity when not found.
+uint64_t findEntry(const SharedMapEntry *entries, uint64_t capacity, uint64_t packed)
+{
+  uint64_t index = homeEntry(packed, capacity);
+  for (uint64_t probe = 0; probe < capacity; ++probe)
+  {
+    const uint64_t key = entries[index].key.load(std::memory_order_acquire);
+    if (key == packed)
+    {
+      return index;
+    }
+    if (key == kEntryEmpty)
+    {
+      break;
+    }
+    index = (index + 1u) & (capacity - 1u);
+  }
+  return capacity;
+}
+
+
+/// Find a free directory entry for @p packed , which must not already be in the directory.
+/// @return The entry index, or the directory capacity when the directory is full.
+uint64_t freeEntry(const SharedMapEntry *entries, uint64_t capacity, uint64_t packed)
+{
+  uint64_t index = homeEntry(packed, capacity);
+  for (uint64_t probe = 0; probe < capacity; ++probe)
+  {
+    const uint64_t key = entries[index].key.load(std::memory_order_relaxed);
+    if (key == kEntryEmpty || key == kEntryRemoved)
+    {
+      return index;
+    }
+    index = (index + 1u) & (capacity - 1u);
+  }
+  return capacity;
+}
+
+
+/// Begin a sequence locked update of @p entry .
+/// @return The sequence value to pass to @c endWrite() .
+uint64_t beginWrite(SharedMapEntry &entry)
+{
+  const uint64_t sequence = entry.sequence.load(std::memory_order_relaxed);
+  entry.sequence.store(sequence + 1u, std::memory_order_relaxed);
+  // Order the odd sequence before the data writes.
+  std::atomic_thread_fence(std::memory_order_release);
+  return sequence;
+}
+
+
+/// Complete an update started with @c beginWrite() .
+void endWrite(SharedMapEntry &entry, uint64_t sequence)
+{
+  entry.sequence.store(sequence + 2u, std::memory_order_release);
+}
+
+
+/// Make a sequence locked read from the slot of @p region_key , retrying reads which overlap an update.
+/// @param copy Function called with the slot memory to copy out the required data.
+template <typename CopyFunc>
+bool readEntry(const MapSharedReaderDetail &d, const glm::i16vec3 &region_key, const CopyFunc &copy, uint64_t *stamp)
+{
+  const uint64_t packed = packRegionKey(region_key);
+  const uint64_t capacity = d.header->capacity;
+  for (unsigned attempt = 0; attempt < kReadAttempts; ++attempt)
+  {
+    const uint64_t index = findEntry(d.entries, capacity, packed);
+    if (index == capacity)
+    {
+      return false;
+    }
+
+    const SharedMapEntry &entry = d.entries[index];
+    const uint64_t sequence = entry.sequence.load(std::memory_order_acquire);
+    if (sequence & 1u)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (entry.key.load(std::memory_order_relaxed) != packed)
+    {
+      // Removed or replaced since the lookup.
+      continue;
+    }
+
+    copy(d.slots + index * d.header->slot_size);
+    const uint64_t region_stamp = entry.stamp.load(std::memory_order_relaxed);
+    // Order the data reads before validating the sequence.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.sequence.load(std::memory_order_relaxed) == sequence)
+    {
+      if (stamp)
+      {
+        *stamp = region_stamp;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
+
+MapSharedPublisher::MapSharedPublisher()
+  : imp_(new MapSharedPublisherDetail)
+{}
+
+
+MapSharedPublisher::~MapSharedPublisher()
+{
+  close();
+}
+
+
+bool MapSharedPublisher::create(const std::string &name, const OccupancyMap &map,
+                                const std::vector<std::string> &layer_names, size_t region_capacity)
+{
+  close();
+  if (layer_names.empty() || layer_names.size() > kMaxLayers)
+  {
+    return false;
+  }
+
+  MapSharedPublisherDetail &d = *imp_;
+  const MapLayout &layout = map.layout();
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+
+  // Resolve the layers and lay out the voxel slot.
+  std::vector<SharedMapLayerInfo> layers(layer_names.size());
+  std::vector<SharedMapLayerSource> sources(layer_names.size());
+  uint64_t slot_size = 0;
+  for (size_t i = 0; i < layer_names.size(); ++i)
+  {
+    const int layer_index = layout.layerIndex(layer_names[i].c_str());
+    if (layer_index < 0 || layer_names[i].size() >= kLayerNameSize)
+    {
+      return false;
+    }
+
+    const MapLayer &layer = layout.layer(layer_index);
+    const unsigned block_layer = layer.isGroupMember() ? unsigned(layer.groupLayer()) : unsigned(layer_index);
+    const MapLayer &block = layout.layer(block_layer);
+
+    SharedMapLayerSource &source = sources[i];
+    source.layer = unsigned(layer_index);
+    source.block_layer = block_layer;
+    source.slot_offset = slot_size;
+    for (size_t j = 0; j < i; ++j)
+    {
+      if (sources[j].block_layer == block_layer)
+      {
+        // Shares a group layer already in the slot.
+        source.slot_offset = sources[j].slot_offset;
+        source.copy = false;
+        break;
+      }
+    }
+
+    SharedMapLayerInfo &info = layers[i];
+    std::memset(&info, 0, sizeof(info));
+    std::strncpy(info.name, layer_names[i].c_str(), kLayerNameSize - 1u);
+    info.slot_offset = source.slot_offset;
+    info.byte_size = block.layerByteSize(region_dim);
+    info.voxel_size = uint32_t(layer.voxelByteSize());
+    info.voxel_stride = uint32_t(layer.voxelStride());
+    info.voxel_offset = layer.isGroupMember() ? layer.groupOffset() : 0u;
+    const glm::u8vec3 layer_dim = block.dimensions(region_dim);
+    info.dim[0] = layer_dim.x;
+    info.dim[1] = layer_dim.y;
+    info.dim[2] = layer_dim.z;
+    info.subsampling = uint8_t(block.subsampling());
+    info.voxel_order = uint8_t(map.layerVoxelOrder(int(block_layer)));
+
+    if (source.copy)
+    {
+      slot_size = align(slot_size + info.byte_size);
+    }
+  }
+
+  uint64_t capacity = 1u;
+  while (capacity < region_capacity)
+  {
+    capacity <<= 1u;
+  }
+
+  const uint64_t directory_offset = align(sizeof(SharedMapHeader));
+  const uint64_t slots_offset = align(directory_offset + capacity * sizeof(SharedMapEntry));
+  const uint64_t segment_size = slots_offset + capacity * slot_size;
+  if (segment_size != size_t(segment_size) || !d.segment.create(name, size_t(segment_size)))
+  {
+    return false;
+  }
+
+  // The segment is zero filled, which is a valid initial state for the lock free atomics.
+  uint8_t *mem = d.segment.data();
+  d.header = reinterpret_cast<SharedMapHeader *>(mem);                       // NOLINT
+  d.entries = reinterpret_cast<SharedMapEntry *>(mem + directory_offset);  // NOLINT
+  d.slots = mem + slots_offset;
+  d.sources = sources;
+  d.name = name;
+
+  SharedMapHeader &header = *d.header;
+  header.version = kVersion;
+  header.segment_size = segment_size;
+  header.resolution = map.resolution();
+  header.origin[0] = map.origin().x;
+  header.origin[1] = map.origin().y;
+  header.origin[2] = map.origin().z;
+  header.region_dim[0] = region_dim.x;
+  header.region_dim[1] = region_dim.y;
+  header.region_dim[2] = region_dim.z;
+  header.layer_count = uint32_t(layers.size());
+  header.capacity = capacity;
+  header.slot_size = slot_size;
+  header.directory_offset = directory_offset;
+  header.slot_offset = slots_offset;
+  std::copy(layers.begin(), layers.end(), header.layers);
+  header.magic.store(kMagic, std::memory_order_release);
+
+  return true;
+}
+
+
+void MapSharedPublisher::close()
+{
+  MapSharedPublisherDetail &d = *imp_;
+  d.segment.close();
+  d.header = nullptr;
+  d.entries = nullptr;
+  d.slots = nullptr;
+  d.sources.clear();
+  d.published.clear();
+  d.dropped_count = 0;
+  d.name.clear();
+}
+
+
+bool MapSharedPublisher::isOpen() const
+{
+  return imp_->segment.isOpen();
+}
+
+
+const std::string &MapSharedPublisher::name() const
+{
+  return imp_->name;
+}
+
+
+size_t MapSharedPublisher::publish(const OccupancyMap &map)
+{
+  MapSharedPublisherDetail &d = *imp_;
+  if (!d.header)
+  {
+    return 0;
+  }
+
+  SharedMapHeader &header = *d.header;
+  const uint64_t capacity = header.capacity;
+  const uint64_t epoch = header.epoch.load(std::memory_order_relaxed) + 1u;
+
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+
+  std::vector<bool> seen(capacity, false);
+  std::vector<VoxelBuffer<const VoxelBlock>> buffers(d.sources.size());
+  size_t changed = 0;
+  d.dropped_count = 0;
+
+  for (const MapChunk *chunk : chunks)
+  {
+    const glm::i16vec3 region_key = chunk->region.coord;
+    uint64_t stamp = 0;
+    for (const SharedMapLayerSource &source : d.sources)
+    {
+      stamp = std::max(stamp, chunk->layerTouchedStamp(source.layer));
+    }
+
+    auto iter = d.published.find(region_key);
+    bool added = false;
+    if (iter == d.published.end())
+    {
+      const uint64_t index = freeEntry(d.entries, capacity, packRegionKey(region_key));
+      if (index == capacity)
+      {
+        ++d.dropped_count;
+        continue;
+      }
+      iter = d.published.emplace(region_key, index).first;
+      added = true;
+    }
+
+    const uint64_t index = iter->second;
+    SharedMapEntry &entry = d.entries[index];
+    seen[index] = true;
+    if (!added && entry.stamp.load(std::memory_order_relaxed) == stamp)
+    {
+      continue;
+    }
+
+    // Retain the blocks first: this may uncompress them, which should not extend the locked update.
+    for (size_t i = 0; i < d.sources.size(); ++i)
+    {
+      if (d.sources[i].copy)
+      {
+        buffers[i] = VoxelBuffer<const VoxelBlock>(chunk->voxel_blocks[d.sources[i].block_layer]);
+      }
+    }
+
+    uint8_t *slot = d.slots + index * header.slot_size;
+    const uint64_t sequence = beginWrite(entry);
+    entry.key.store(packRegionKey(region_key), std::memory_order_relaxed);
+    for (size_t i = 0; i < d.sources.size(); ++i)
+    {
+      if (d.sources[i].copy)
+      {
+        const size_t byte_size = std::min<size_t>(header.layers[i].byte_size, buffers[i].voxelMemorySize());
+        std::memcpy(slot + d.sources[i].slot_offset, buffers[i].voxelMemory(), byte_size);
+      }
+    }
+    entry.stamp.store(stamp, std::memory_order_relaxed);
+    entry.epoch.store(epoch, std::memory_order_relaxed);
+    endWrite(entry, sequence);
+    ++changed;
+
+    for (auto &buffer : buffers)
+    {
+      buffer.release();
+    }
+  }
+
+  // Remove regions no longer in the map.
+  for (auto iter = d.published.begin(); iter != d.published.end();)
+  {
+    if (seen[iter->second])
+    {
+      ++iter;
+      continue;
+    }
+
+    SharedMapEntry &entry = d.entries[iter->second];
+    const uint64_t sequence = beginWrite(entry);
+    entry.key.store(kEntryRemoved, std::memory_order_relaxed);
+    entry.epoch.store(epoch, std::memory_order_relaxed);
+    endWrite(entry, sequence);
+    iter = d.published.erase(iter);
+    ++changed;
+  }
+
+  header.region_count.store(d.published.size(), std::memory_order_relaxed);
+  header.map_stamp.store(map.stamp(), std::memory_order_relaxed);
+  header.epoch.store(epoch, std::memory_order_release);
+
+  return changed;
+}
+
+
+size_t MapSharedPublisher::regionCapacity() const
+{
+  return (imp_->header) ? size_t(imp_->header->capacity) : 0u;
+}
+
+
+size_t MapSharedPublisher::regionCount() const
+{
+  return imp_->published.size();
+}
+
+
+size_t MapSharedPublisher::droppedRegionCount() const
+{
+  return imp_->dropped_count;
+}
+
+
+uint64_t MapSharedPublisher::epoch() const
+{
+  return (imp_->header) ? imp_->header->epoch.load(std::memory_order_relaxed) : 0u;
+}
+
+
+MapSharedReader::MapSharedReader()
+  : imp_(new MapSharedReaderDetail)
+{}
+
+
+MapSharedReader::~MapSharedReader()
+{
+  close();
+}
+
+
+bool MapSharedReader::open(const std::string &name)
+{
+  close();
+  MapSharedReaderDetail &d = *imp_;
+  if (!d.segment.open(name))
+  {
+    return false;
+  }
+
+  const uint8_t *mem = d.segment.data();
+  const auto *header = reinterpret_cast<const SharedMapHeader *>(mem);  // NOLINT
+  const bool valid = d.segment.size() >= sizeof(SharedMapHeader) &&
+                     header->magic.load(std::memory_order_acquire) == kMagic && header->version == kVersion &&
+                     header->segment_size <= d.segment.size() && header->layer_count <= kMaxLayers &&
+                     header->capacity > 0 && (header->capacity & (header->capacity - 1u)) == 0;
+  if (!valid)
+  {
+    d.segment.close();
+    return false;
+  }
+
+  d.header = header;
+  d.entries = reinterpret_cast<const SharedMapEntry *>(mem + header->directory_offset);  // NOLINT
+  d.slots = mem + header->slot_offset;
+  d.region_spatial_dim = glm::dvec3(header->region_dim[0], header->region_dim[1], header->region_dim[2]) *
+                         header->resolution;
+  return true;
+}
+
+
+void MapSharedReader::close()
+{
+  MapSharedReaderDetail &d = *imp_;
+  d.segment.close();
+  d.header = nullptr;
+  d.entries = nullptr;
+  d.slots = nullptr;
+}
+
+
+bool MapSharedReader::isOpen() const
+{
+  return imp_->header != nullptr;
+}
+
+
+uint64_t MapSharedReader::epoch() const
+{
+  return (imp_->header) ? imp_->header->epoch.load(std::memory_order_acquire) : 0u;
+}
+
+
+uint64_t MapSharedReader::mapStamp() const
+{
+  return (imp_->header) ? imp_->header->map_stamp.load(std::memory_order_relaxed) : 0u;
+}
+
+
+size_t MapSharedReader::regionCount() const
+{
+  return (imp_->header) ? size_t(imp_->header->region_count.load(std::memory_order_relaxed)) : 0u;
+}
+
+
+double MapSharedReader::resolution() const
+{
+  return (imp_->header) ? imp_->header->resolution : 0.0;
+}
+
+
+glm::dvec3 MapSharedReader::origin() const
+{
+  const SharedMapHeader *header = imp_->header;
+  return (header) ? glm::dvec3(header->origin[0], header->origin[1], header->origin[2]) : glm::dvec3(0.0);
+}
+
+
+glm::u8vec3 MapSharedReader::regionVoxelDimensions() const
+{
+  const SharedMapHeader *header = imp_->header;
+  return (header) ? glm::u8vec3(header->region_dim[0], header->region_dim[1], header->region_dim[2]) :
+                    glm::u8vec3(0);
+}
+
+
+unsigned MapSharedReader::layerCount() const
+{
+  return (imp_->header) ? imp_->header->layer_count : 0u;
+}
+
+
+const char *MapSharedReader::layerName(unsigned layer) const
+{
+  return (layer < layerCount()) ? imp_->header->layers[layer].name : nullptr;
+}
+
+
+int MapSharedReader::layerIndex(const char *name) const
+{
+  for (unsigned i = 0; i < layerCount(); ++i)
+  {
+    if (std::strncmp(imp_->header->layers[i].name, name, kLayerNameSize) == 0)
+    {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+
+size_t MapSharedReader::voxelByteSize(unsigned layer) const
+{
+  return (layer < layerCount()) ? imp_->header->layers[layer].voxel_size : 0u;
+}
+
+
+VoxelOrder MapSharedReader::layerVoxelOrder(unsigned layer) const
+{
+  return (layer < layerCount()) ? VoxelOrder(imp_->header->layers[layer].voxel_order) : VoxelOrder::kRowMajor;
+}
+
+
+Key MapSharedReader::voxelKey(const glm::dvec3 &point) const
+{
+  Key key = Key::kNull;
+  if (imp_->header)
+  {
+    const glm::dvec3 map_origin = origin();
+    const MapRegion region(point, map_origin, imp_->region_spatial_dim);
+    region.voxelKey(key, point, map_origin, imp_->region_spatial_dim, glm::ivec3(regionVoxelDimensions()),
+                    resolution());
+  }
+  return key;
+}
+
+
+bool MapSharedReader::hasRegion(const glm::i16vec3 &region_key) const
+{
+  const MapSharedReaderDetail &d = *imp_;
+  return d.header &&
+         findEntry(d.entries, d.header->capacity, packRegionKey(region_key)) != d.header->capacity;
+}
+
+
+size_t MapSharedReader::regionKeys(std::vector<glm::i16vec3> &region_keys) const
+{
+  const MapSharedReaderDetail &d = *imp_;
+  region_keys.clear();
+  if (!d.header)
+  {
+    return 0;
+  }
+
+  for (uint64_t i = 0; i < d.header->capacity; ++i)
+  {
+    const uint64_t key = d.entries[i].key.load(std::memory_order_relaxed);
+    if (key != kEntryEmpty && key != kEntryRemoved)
+    {
+      region_keys.emplace_back(unpackRegionKey(key));
+    }
+  }
+  return region_keys.size();
+}
+
+
+bool MapSharedReader::readVoxel(const Key &key, unsigned layer, void *value, uint64_t *stamp) const
+{
+  const MapSharedReaderDetail &d = *imp_;
+  if (key.isNull() || layer >= layerCount())
+  {
+    return false;
+  }
+
+  const SharedMapLayerInfo &info = d.header->layers[layer];
+  const glm::u8vec3 local = key.localKey();
+  const glm::u8vec3 layer_local(local.x >> info.subsampling, local.y >> info.subsampling,
+                                local.z >> info.subsampling);
+  const uint64_t voxel_index = ohm::voxelIndex(layer_local, glm::ivec3(info.dim[0], info.dim[1], info.dim[2]),
+                                               VoxelOrder(info.voxel_order));
+  const uint64_t offset = voxel_index * info.voxel_stride + info.voxel_offset;
+  if (offset + info.voxel_size > info.byte_size)
+  {
+    return false;
+  }
+
+  const uint64_t slot_offset = info.slot_offset + offset;
+  const size_t voxel_size = info.voxel_size;
+  return readEntry(
+    d, key.regionKey(), [value, slot_offset, voxel_size](const uint8_t *slot) {
+      std::memcpy(value, slot + slot_offset, voxel_size);
+    },
+    stamp);
+}
+
+
+bool MapSharedReader::readRegion(const glm::i16vec3 &region_key, unsigned layer, std::vector<uint8_t> &buffer,
+                                 uint64_t *stamp) const
+{
+  const MapSharedReaderDetail &d = *imp_;
+  if (layer >= layerCount())
+  {
+    return false;
+  }
+
+  const SharedMapLayerInfo &info = d.header->layers[layer];
+  buffer.resize(size_t(info.byte_size));
+  uint8_t *dst = buffer.data();
+  return readEntry(
+    d, region_key, [dst, &info](const uint8_t *slot) { std::memcpy(dst, slot + info.slot_offset, info.byte_size); },
+    stamp);
+}
+}  // namespace ohm
@@ -0,0 +1,252 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPSHAREDMEMORY_H
+#define OHM_MAPSHAREDMEMORY_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "VoxelOrder.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct MapSharedPublisherDetail;
+struct MapSharedReaderDetail;
+
+/// Publishes a read only replica of selected map layers in a named shared memory segment, which other processes open
+/// using a @c MapSharedReader .
+///
+/// The segment holds a fixed capacity region directory and one voxel slot per directory entry, sized for the
+/// selected layers. Each @c publish() copies the regions whose selected layers have changed since they were last
+/// published into their slots, and removes regions which are no longer in the map. Readers access the voxel slots in
+/// place, with no per publish copy or message. Updates use a sequence lock per region, so neither side blocks the
+/// other: readers retry a read which overlaps an update of the same region.
+///
+/// Regions beyond the directory capacity are not published - see @c droppedRegionCount() . The capacity cannot change
+/// once created.
+///
+/// The segment is created with POSIX shared memory, or as a named page file mapping on Windows. The segment name is
+/// removed on @c close() or destruction; readers which already have the segment open retain their mapping.
+///
+/// Typical usage:
+/// @code
+/// // Map owner process.
+/// ohm::MapSharedPublisher publisher;
+/// publisher.create("ohm_map", map, { "occupancy" }, 4096);
+/// while (mapping)
+/// {
+///   integrateRays(map);
+///   publisher.publish(map);
+/// }
+///
+/// // Reader process.
+/// ohm::MapSharedReader reader;
+/// reader.open("ohm_map");
+/// const int occupancy_layer = reader.layerIndex("occupancy");
+/// float occupancy = 0;
+/// reader.readVoxel(reader.voxelKey(point), occupancy_layer, &occupancy);
+/// @endcode
+class ohm_API MapSharedPublisher
+{
+public:
+  /// Constructor: no segment.
+  MapSharedPublisher();
+  /// Destructor: calls @c close() .
+  ~MapSharedPublisher();
+
+  MapSharedPublisher(const MapSharedPublisher &) = delete;
+  MapSharedPublisher &operator=(const MapSharedPublisher &) = delete;
+
+  /// Create the shared segment for publishing @p map . Nothing is published until @c publish() is called.
+  ///
+  /// A layer group member is published with the whole group layer as it shares the group voxel memory.
+  ///
+  /// @param name The segment name.
+  /// @param map The map to publish. Only used to configure the segment.
+  /// @param layer_names Names of the layers to publish. Up to 16 layers.
+  /// @param region_capacity The maximum number of published regions. Rounded up to a power of two.
+  /// @return True on success. Fails if a layer is not found or the segment cannot be created.
+  bool create(const std::string &name, const OccupancyMap &map, const std::vector<std::string> &layer_names,
+              size_t region_capacity);
+
+  /// Close and remove the shared segment.
+  void close();
+
+  /// Check if the segment has been created.
+  /// @return True when open.
+  bool isOpen() const;
+
+  /// Query the segment name.
+  /// @return The name passed to @c create() .
+  const std::string &name() const;
+
+  /// Publish changes in @p map to the shared segment.
+  ///
+  /// @p map must have the same layout used in @c create() . Must not be called concurrently with changes to @p map .
+  ///
+  /// @param map The map to publish.
+  /// @return The number of regions written or removed.
+  size_t publish(const OccupancyMap &map);
+
+  /// Query the maximum number of published regions.
+  /// @return The region capacity.
+  size_t regionCapacity() const;
+
+  /// Query the number of published regions.
+  /// @return The published region count.
+  size_t regionCount() const;
+
+  /// Query the number of regions not published by the last @c publish() because the directory was full.
+  /// @return The dropped region count.
+  size_t droppedRegionCount() const;
+
+  /// Query the number of @c publish() calls made.
+  /// @return The publish epoch.
+  uint64_t epoch() const;
+
+private:
+  std::unique_ptr<MapSharedPublisherDetail> imp_;
+};
+
+
+/// Read only access to map layers published by a @c MapSharedPublisher , usually in another process.
+///
+/// Reads copy only the requested voxels or regions out of the shared segment and see updates as they are published.
+/// All read functions are safe to call concurrently. A read fails if the region is not published, or if it could not
+/// be completed while the publisher repeatedly updated the same region.
+class ohm_API MapSharedReader
+{
+public:
+  /// Constructor: no segment.
+  MapSharedReader();
+  /// Destructor: calls @c close() .
+  ~MapSharedReader();
+
+  MapSharedReader(const MapSharedReader &) = delete;
+  MapSharedReader &operator=(const MapSharedReader &) = delete;
+
+  /// Open a published segment.
+  /// @param name The segment name, as given to @c MapSharedPublisher::create() .
+  /// @return True on success. Fails if the segment does not exist or is not a valid map segment.
+  bool open(const std::string &name);
+
+  /// Close the segment.
+  void close();
+
+  /// Check if a segment is open.
+  /// @return True when open.
+  bool isOpen() const;
+
+  /// Query the number of publishes made. Poll to detect updates.
+  /// @return The publish epoch.
+  uint64_t epoch() const;
+
+  /// Query the @c OccupancyMap::stamp() of the source map at the last publish.
+  /// @return The source map stamp.
+  uint64_t mapStamp() const;
+
+  /// Query the number of published regions.
+  /// @return The region count.
+  size_t regionCount() const;
+
+  /// Query the source map voxel resolution.
+  /// @return The voxel resolution.
+  double resolution() const;
+
+  /// Query the source map origin.
+  /// @return The map origin.
+  glm::dvec3 origin() const;
+
+  /// Query the source map region voxel dimensions.
+  /// @return The region dimensions.
+  glm::u8vec3 regionVoxelDimensions() const;
+
+  /// Query the number of published layers.
+  /// @return The layer count.
+  unsigned layerCount() const;
+
+  /// Query the name of a published layer.
+  /// @param layer The published layer index.
+  /// @return The layer name, or null for an invalid @p layer .
+  const char *layerName(unsigned layer) const;
+
+  /// Find a published layer by name.
+  /// @param name The layer name.
+  /// @return The published layer index, or -1 when not published.
+  int layerIndex(const char *name) const;
+
+  /// Query the byte size of each voxel in a published layer.
+  /// @param layer The published layer index.
+  /// @return The voxel byte size, or zero for an invalid @p layer .
+  size_t voxelByteSize(unsigned layer) const;
+
+  /// Query the order of the voxels of a published layer, as copied by @c readRegion() .
+  /// @param layer The published layer index.
+  /// @return The layer voxel order, or @c VoxelOrder::kRowMajor for an invalid @p layer .
+  VoxelOrder layerVoxelOrder(unsigned layer) const;
+
+  /// Calculate the key of the voxel containing @p point in the source map.
+  /// @param point The point of interest.
+  /// @return The voxel key.
+  Key voxelKey(const glm::dvec3 &point) const;
+
+  /// Check if a region is published.
+  /// @param region_key The region key.
+  /// @return True when published.
+  bool hasRegion(const glm::i16vec3 &region_key) const;
+
+  /// Collect the keys of the published regions.
+  /// @param[out] region_keys Set to the published region keys.
+  /// @return The number of regions.
+  size_t regionKeys(std::vector<glm::i16vec3> &region_keys) const;
+
+  /// Read a voxel from a published layer.
+  /// @param key The voxel key.
+  /// @param layer The published layer index.
+  /// @param[out] value Set to the voxel value. Must have @c voxelByteSize() bytes.
+  /// @param[out] stamp Optionally set to the region touched stamp of the data read.
+  /// @return True on success.
+  bool readVoxel(const Key &key, unsigned layer, void *value, uint64_t *stamp = nullptr) const;
+
+  /// Read a voxel from a published layer, checking the value size.
+  /// @param key The voxel key.
+  /// @param layer The published layer index.
+  /// @param[out] value Set to the voxel value.
+  /// @return True on success. Fails if @c T does not match the @c voxelByteSize() .
+  template <typename T>
+  inline bool readVoxel(const Key &key, int layer, T *value) const
+  {
+    return layer >= 0 && voxelByteSize(unsigned(layer)) == sizeof(T) &&
+           readVoxel(key, unsigned(layer), static_cast<void *>(value), nullptr);
+  }
+
+  /// Copy a published layer of a region, as stored in the @c MapChunk voxel blocks. Voxels are in the
+  /// @c layerVoxelOrder() .
+  ///
+  /// For a layer group member, the whole group layer is copied.
+  ///
+  /// @param region_key The region key.
+  /// @param layer The published layer index.
+  /// @param[out] buffer Set to the layer voxels.
+  /// @param[out] stamp Optionally set to the region touched stamp of the data read.
+  /// @return True on success.
+  bool readRegion(const glm::i16vec3 &region_key, unsigned layer, std::vector<uint8_t> &buffer,
+                  uint64_t *stamp = nullptr) const;
+
+private:
+  std::unique_ptr<MapSharedReaderDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPSHAREDMEMORY_H
@@ -0,0 +1,162 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapSnapshot.h"
+
+#include "MapChunk.h"
+#include "MapLayer.h"
+#include "OccupancyMap.h"
+#include "VoxelBlock.h"
+#include "VoxelBuffer.h"
+
+#include <ohmutil/Profile.h>
+
+#include <cstring>
+
+namespace ohm
+{
+namespace
+{
+/// Can the @p previous snapshot data for @p layer_index be shared for @p chunk ?
+bool isLayerUnchanged(const MapSnapshot::Region &previous, const MapChunk &chunk, size_t layer_index)
+{
+  const std::shared_ptr<const MapSnapshot::LayerData> &layer = previous.layers[layer_index];
+  return layer && layer->touched_stamp == chunk.layerTouchedStamp(unsigned(layer_index));
+}
+}  // namespace
+
+const MapSnapshot::Region *MapSnapshot::region(const glm::i16vec3 &region_key) const
+{
+  const auto iter = regions_.find(region_key);
+  return (iter != regions_.end()) ? iter->second.get() : nullptr;
+}
+
+
+const uint8_t *MapSnapshot::layerMemory(const glm::i16vec3 &region_key, int layer_index) const
+{
+  const Region *region_data = region(region_key);
+  if (!region_data || layer_index < 0 || size_t(layer_index) >= region_data->layers.size() ||
+      !region_data->layers[layer_index])
+  {
+    return nullptr;
+  }
+  return region_data->layers[layer_index]->bytes.data();
+}
+
+
+MapSnapshotPublisher::MapSnapshotPublisher(const OccupancyMap &map)
+  : map_(&map)
+{}
+
+
+std::shared_ptr<const MapSnapshot> MapSnapshotPublisher::publish()
+{
+  PROFILE(MapSnapshotPublisher_publish);
+  const std::shared_ptr<const MapSnapshot> previous = latest();
+  auto snapshot = std::make_shared<MapSnapshot>();
+
+  const MapLayout &layout = map_->layout();
+  const size_t layer_count = layout.layerCount();
+  snapshot->layout_ = layout;
+  snapshot->region_voxel_dimensions_ = map_->regionVoxelDimensions();
+  snapshot->origin_ = map_->origin();
+  snapshot->rebase_offset_ = map_->rebaseOffset();
+  snapshot->stamp_ = map_->stamp();
+  snapshot->epoch_ = ++epoch_;
+  for (size_t i = 0; i < layer_count; ++i)
+  {
+    snapshot->layer_dimensions_.emplace_back(layout.layer(i).dimensions(snapshot->region_voxel_dimensions_));
+    snapshot->layer_orders_.emplace_back(map_->layerVoxelOrder(int(i)));
+  }
+
+  // Layer data can only be shared when the layout is unchanged.
+  const bool share_layers = previous && previous->layout_.layerCount() == layer_count &&
+                            previous->layout_.checkEquivalent(layout) == MapLayoutMatch::kExact;
+
+  // Region keys shift by the difference in rebase offset from the previous snapshot. Map the current keys back into
+  // the previous key space to find the previous region data.
+  const glm::dvec3 to_previous_shift = (previous) ? previous->rebase_offset_ - snapshot->rebase_offset_ : glm::dvec3(0);
+
+  std::vector<const MapChunk *> chunks;
+  map_->enumerateRegions(chunks);
+  snapshot->regions_.reserve(chunks.size());
+  size_t copied_count = 0;
+  for (const MapChunk *chunk : chunks)
+  {
+    glm::i16vec3 previous_key = chunk->region.coord;
+    const bool has_previous_key = share_layers && OccupancyMap::shiftRegionKey(previous_key, to_previous_shift);
+    const auto previous_iter =
+      (has_previous_key) ? previous->regions_.find(previous_key) : MapSnapshot::RegionMap::const_iterator();
+    const MapSnapshot::Region *previous_region =
+      (has_previous_key && previous_iter != previous->regions_.end()) ? previous_iter->second.get() : nullptr;
+
+    // A re-keyed region is always dirtied by the rebase so is never shared whole with a stale key.
+    if (previous_region && previous_region->dirty_stamp == chunk->dirty_stamp)
+    {
+      bool unchanged = true;
+      for (size_t i = 0; unchanged && i < layer_count; ++i)
+      {
+        unchanged = isLayerUnchanged(*previous_region, *chunk, i);
+      }
+
+      if (unchanged)
+      {
+        // Share the whole region.
+        snapshot->regions_.emplace(chunk->region.coord, previous_iter->second);
+        continue;
+      }
+    }
+
+    auto region = std::make_shared<MapSnapshot::Region>();
+    region->coord = chunk->region.coord;
+    region->dirty_stamp = chunk->dirty_stamp;
+    region->layers.resize(layer_count);
+    for (size_t i = 0; i < layer_count; ++i)
+    {
+      if (previous_region && isLayerUnchanged(*previous_region, *chunk, i))
+      {
+        region->layers[i] = previous_region->layers[i];
+        continue;
+      }
+
+      auto layer_data = std::make_shared<MapSnapshot::LayerData>();
+      const VoxelBuffer<const VoxelBlock> buffer(chunk->voxel_blocks[i]);
+      if (buffer.voxelStride())
+      {
+        // Group member: gather the interleaved voxels.
+        const size_t voxel_size = layout.layer(i).voxelByteSize();
+        const size_t voxel_count = buffer.voxelMemorySize() / voxel_size;
+        layer_data->bytes.resize(buffer.voxelMemorySize());
+        for (size_t v = 0; v < voxel_count; ++v)
+        {
+          memcpy(layer_data->bytes.data() + v * voxel_size, buffer.voxelMemory() + v * buffer.voxelStride(),
+                 voxel_size);
+        }
+      }
+      else
+      {
+        layer_data->bytes.assign(buffer.voxelMemory(), buffer.voxelMemory() + buffer.voxelMemorySize());
+      }
+      layer_data->touched_stamp = chunk->layerTouchedStamp(unsigned(i));
+      region->layers[i] = layer_data;
+      ++copied_count;
+    }
+    snapshot->regions_.emplace(region->coord, region);
+  }
+
+  last_copied_layer_count_ = copied_count;
+  std::shared_ptr<const MapSnapshot> published = snapshot;
+  std::unique_lock<Mutex> guard(latest_mutex_);
+  latest_ = published;
+  return published;
+}
+
+
+std::shared_ptr<const MapSnapshot> MapSnapshotPublisher::latest() const
+{
+  std::unique_lock<Mutex> guard(latest_mutex_);
+  return latest_;
+}
+}  // namespace ohm
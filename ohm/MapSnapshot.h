@@ -0,0 +1,196 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPSNAPSHOT_H
+#define OHM_MAPSNAPSHOT_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "MapRegion.h"
+#include "Mutex.h"
+
+#include <glm/vec3.hpp>
+
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// An immutable, point in time copy of the voxel data of an @c OccupancyMap , published by a
+/// @c MapSnapshotPublisher .
+///
+/// A snapshot may be read from any thread while the source map continues to be updated. Snapshots share the
+/// voxel data of unchanged region layers with the snapshots published before and after them, so holding a snapshot
+/// costs only the memory of the layers changed since.
+///
+/// Voxel keys may be calculated using the source map - e.g., @c OccupancyMap::voxelKey() - which only reads the map
+/// geometry. An @c OccupancyMap::rebaseOrigin() changes that geometry, so keys calculated from the map are only valid
+/// for snapshots with a matching @c rebaseOffset() . The snapshot @c origin() identifies the key space of older
+/// snapshots.
+class ohm_API MapSnapshot
+{
+public:
+  /// Uncompressed voxel data for one layer of one region.
+  struct ohm_API LayerData
+  {
+    /// The voxel memory.
+    std::vector<uint8_t> bytes;
+    /// The @c MapChunk::touched_stamps value for the layer when copied.
+    uint64_t touched_stamp = 0;
+  };
+
+  /// The voxel data of a single region.
+  struct ohm_API Region
+  {
+    /// The region key.
+    glm::i16vec3 coord{ 0, 0, 0 };
+    /// The @c MapChunk::dirty_stamp when copied.
+    uint64_t dirty_stamp = 0;
+    /// Voxel data for each map layer.
+    std::vector<std::shared_ptr<const LayerData>> layers;
+  };
+
+  /// Region lookup table.
+  using RegionMap = std::unordered_map<glm::i16vec3, std::shared_ptr<const Region>, MapRegion::Hash>;
+
+  /// Query the @c OccupancyMap::stamp() at which the snapshot was taken.
+  /// @return The map stamp.
+  inline uint64_t stamp() const { return stamp_; }
+  /// Query the publication epoch - incremented for each snapshot published by a @c MapSnapshotPublisher .
+  /// @return The snapshot epoch.
+  inline uint64_t epoch() const { return epoch_; }
+  /// Query the map layout at the time of the snapshot.
+  /// @return The map layout.
+  inline const MapLayout &layout() const { return layout_; }
+  /// Query the map region voxel dimensions.
+  /// @return The region voxel dimensions.
+  inline const glm::u8vec3 &regionVoxelDimensions() const { return region_voxel_dimensions_; }
+  /// Query the map origin at the time of the snapshot.
+  /// @return The map origin.
+  inline const glm::dvec3 &origin() const { return origin_; }
+  /// Query the map @c OccupancyMap::rebaseOffset() at the time of the snapshot.
+  /// @return The accumulated region key shift.
+  inline const glm::dvec3 &rebaseOffset() const { return rebase_offset_; }
+  /// Query the number of regions in the snapshot.
+  /// @return The region count.
+  inline size_t regionCount() const { return regions_.size(); }
+  /// Access the region table for iteration.
+  /// @return The snapshot regions.
+  inline const RegionMap &regions() const { return regions_; }
+
+  /// Lookup the region at @p region_key .
+  /// @param region_key The region of interest.
+  /// @return The region data or null if the region was not present in the map.
+  const Region *region(const glm::i16vec3 &region_key) const;
+
+  /// Query the voxel memory of @p layer_index in the region at @p region_key .
+  /// @param region_key The region of interest.
+  /// @param layer_index The layer of interest.
+  /// @return The voxel memory laid out as for @c MapChunk::voxel_blocks , or null if the region or layer is not
+  ///   present.
+  const uint8_t *layerMemory(const glm::i16vec3 &region_key, int layer_index) const;
+
+  /// Read the voxel at @p key in @p layer_index .
+  /// @param key The voxel to read.
+  /// @param layer_index The layer to read from. The layer voxel size must match @c T .
+  /// @param[out] value Set to the voxel value on success.
+  /// @return True if the voxel region and layer exist and @p value has been set.
+  /// @tparam T The voxel data type.
+  template <typename T>
+  bool read(const Key &key, int layer_index, T *value) const;
+
+private:
+  friend class MapSnapshotPublisher;
+
+  RegionMap regions_;
+  MapLayout layout_;
+  std::vector<glm::u8vec3> layer_dimensions_;
+  std::vector<VoxelOrder> layer_orders_;
+  glm::u8vec3 region_voxel_dimensions_{ 0, 0, 0 };
+  glm::dvec3 origin_{ 0, 0, 0 };
+  glm::dvec3 rebase_offset_{ 0, 0, 0 };
+  uint64_t stamp_ = 0;
+  uint64_t epoch_ = 0;
+};
+
+
+/// Publishes a sequence of @c MapSnapshot epochs from an @c OccupancyMap to support concurrent readers.
+///
+/// The map writer thread calls @c publish() between updates, such as after @c RayMapper::integrateRays() . Each
+/// publication copies only the region layers whose @c MapChunk::touched_stamps changed since the previous
+/// publication, sharing all other layer data with the previous snapshot. Removed regions are dropped. Regions re-keyed
+/// by an @c OccupancyMap::rebaseOrigin() still share their unchanged layers with the previous snapshot. Reader
+/// threads call @c latest() and may then read the returned snapshot without synchronisation for as long as they
+/// hold it. This replaces publishing with @c OccupancyMap::clone() , which copies the entire map every cycle.
+///
+/// @c publish() reads the map so it must not be called concurrently with map modification. A @c GpuMap must
+/// synchronise the GPU cache to the CPU before publishing. Only regions in memory are published: regions paged out
+/// of memory are not included - see @c OccupancyMap::enableRegionPaging() .
+///
+/// @code
+/// ohm::MapSnapshotPublisher publisher(map);
+/// // Writer thread.
+/// mapper.integrateRays(rays.data(), rays.size());
+/// publisher.publish();
+/// // Reader thread.
+/// std::shared_ptr<const ohm::MapSnapshot> snapshot = publisher.latest();
+/// float occupancy;
+/// if (snapshot && snapshot->read(map.voxelKey(point), snapshot->layout().occupancyLayer(), &occupancy)) { ... }
+/// @endcode
+class ohm_API MapSnapshotPublisher
+{
+public:
+  /// Create a publisher for @p map . The map must outlive the publisher. No snapshot is published until the first
+  /// @c publish() call.
+  /// @param map The map to publish.
+  explicit MapSnapshotPublisher(const OccupancyMap &map);
+
+  /// Publish a new snapshot of the map. Must be called from the writer thread, with no concurrent map changes.
+  /// @return The new snapshot.
+  std::shared_ptr<const MapSnapshot> publish();
+
+  /// Query the most recently published snapshot. Thread safe.
+  /// @return The latest snapshot, or null if nothing has been published.
+  std::shared_ptr<const MapSnapshot> latest() const;
+
+  /// Query the number of region layers copied by the last @c publish() call. Unchanged layers are shared rather
+  /// than copied.
+  /// @return The number of layers copied.
+  inline size_t lastCopiedLayerCount() const { return last_copied_layer_count_; }
+
+private:
+  const OccupancyMap *map_ = nullptr;
+  std::shared_ptr<const MapSnapshot> latest_;
+  mutable Mutex latest_mutex_;
+  uint64_t epoch_ = 0;
+  size_t last_copied_layer_count_ = 0;
+};
+
+
+template <typename T>
+bool MapSnapshot::read(const Key &key, int layer_index, T *value) const
+{
+  const uint8_t *memory = layerMemory(key.regionKey(), layer_index);
+  if (!memory || layout_.layer(layer_index).voxelByteSize() != sizeof(T))
+  {
+    return false;
+  }
+
+  const unsigned index = voxelIndex(key.localKey(), layer_dimensions_[layer_index], layer_orders_[layer_index]);
+  memcpy(value, memory + sizeof(T) * index, sizeof(T));
+  return true;
+}
+}  // namespace ohm
+
+#endif  // OHM_MAPSNAPSHOT_H
@@ -0,0 +1,181 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapUpgrade.h"
+
+#include "CompareMaps.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "TaskArena.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <unordered_set>
+
+namespace ohm
+{
+namespace
+{
+/// Count the regions of @p map which differ from @p reference in any layer of @p reference .
+size_t countMismatchedRegions(const OccupancyMap &reference, const OccupancyMap &map)
+{
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> mismatched;
+  compare::RegionHashes reference_hashes;
+  compare::RegionHashes hashes;
+  const MapLayout &layout = reference.layout();
+  for (size_t i = 0; i < layout.layerCount(); ++i)
+  {
+    const std::string layer_name = layout.layer(i).name();
+    compare::regionHashes(reference, layer_name, reference_hashes, compare::kParallel);
+    if (!compare::regionHashes(map, layer_name, hashes, compare::kParallel))
+    {
+      // Missing layer.
+      hashes.clear();
+    }
+
+    for (const auto &entry : reference_hashes)
+    {
+      const auto iter = hashes.find(entry.first);
+      if (iter == hashes.end() || iter->second != entry.second)
+      {
+        mismatched.insert(entry.first);
+      }
+    }
+    for (const auto &entry : hashes)
+    {
+      if (reference_hashes.find(entry.first) == reference_hashes.end())
+      {
+        mismatched.insert(entry.first);
+      }
+    }
+  }
+  return mismatched.size();
+}
+}  // namespace
+
+
+int upgradeMap(const std::string &source, const std::string &destination, const MapUpgradeOptions &options,
+               MapUpgradeResult *result_out)
+{
+  MapUpgradeResult result;
+  result.source = source;
+  result.destination = destination;
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto finish = [&result, &start_time, result_out](int error) {
+    result.error = error;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    if (result_out)
+    {
+      *result_out = result;
+    }
+    return error;
+  };
+
+  OccupancyMap map(1.0);
+  int err = loadHeader(source, map, &result.source_version);
+  if (err)
+  {
+    return finish(err);
+  }
+
+  const bool indexed = options.format == MapUpgradeFormat::kIndexed;
+  const MapVersion &target_version = (indexed) ? kIndexedVersion : kCurrentVersion;
+  if (options.skip_current && result.source_version == target_version)
+  {
+    result.skipped = true;
+    return finish(kSeOk);
+  }
+
+  err = load(source, map);
+  if (err)
+  {
+    return finish(err);
+  }
+  result.region_count = map.regionCount();
+
+  // Write to a temporary file so the destination is only replaced by a complete, verified map.
+  const std::string tmp_path = destination + ".tmp";
+  err = (indexed) ? saveIndexed(tmp_path, map, nullptr, options.indexed_flags) : save(tmp_path, map);
+
+  if (!err && options.verify)
+  {
+    OccupancyMap upgraded(1.0);
+    err = load(tmp_path, upgraded);
+    if (!err)
+    {
+      result.mismatched_regions = countMismatchedRegions(map, upgraded);
+      if (result.mismatched_regions || upgraded.regionCount() != map.regionCount())
+      {
+        err = kSeVerifyFailure;
+      }
+      else
+      {
+        result.verified = true;
+      }
+    }
+  }
+
+  if (err)
+  {
+    std::remove(tmp_path.c_str());
+    return finish(err);
+  }
+
+  std::remove(destination.c_str());
+  if (std::rename(tmp_path.c_str(), destination.c_str()) != 0)
+  {
+    return finish(kSeFileCreateFailure);
+  }
+
+  return finish(kSeOk);
+}
+
+
+size_t upgradeMaps(const std::vector<std::pair<std::string, std::string>> &files, const MapUpgradeOptions &options,
+                   std::vector<MapUpgradeResult> &results, const MapUpgradeCallback &on_complete)
+{
+  results.clear();
+  results.resize(files.size());
+  std::mutex callback_lock;
+
+  const auto upgrade_files = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+    {
+      upgradeMap(files[i].first, files[i].second, options, &results[i]);
+      if (on_complete)
+      {
+        std::unique_lock<std::mutex> guard(callback_lock);
+        on_complete(results[i]);
+      }
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  // One file per task: files vary greatly in size.
+  parallelExecute([&files, &upgrade_files]() {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0u, files.size(), 1u),
+                      [&upgrade_files](const tbb::blocked_range<size_t> &range) {
+                        upgrade_files(range.begin(), range.end());
+                      });
+  });
+#else   // OHM_FEATURE_THREADS
+  upgrade_files(0, files.size());
+#endif  // OHM_FEATURE_THREADS
+
+  size_t success_count = 0;
+  for (const MapUpgradeResult &result : results)
+  {
+    success_count += (result.error == kSeOk) ? 1u : 0u;
+  }
+  return success_count;
+}
+}  // namespace ohm
@@ -0,0 +1,101 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPUPGRADE_H
+#define OHM_MAPUPGRADE_H
+
+#include "OhmConfig.h"
+
+#include "MapSerialise.h"
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ohm
+{
+/// Target format for @c upgradeMap() .
+enum class MapUpgradeFormat
+{
+  /// The @c kCurrentVersion streamed format written by @c save() .
+  kCurrent,
+  /// The @c kIndexedVersion random access format written by @c saveIndexed() .
+  kIndexed
+};
+
+/// Options for @c upgradeMap() and @c upgradeMaps() .
+struct ohm_API MapUpgradeOptions
+{
+  /// The format to upgrade to.
+  MapUpgradeFormat format = MapUpgradeFormat::kIndexed;
+  /// @c IndexedMapFlag values used for @c MapUpgradeFormat::kIndexed .
+  unsigned indexed_flags = kImfCompress | kImfParallel;
+  /// Reload the upgraded map and verify the @c compare::regionHash() of every region layer against the source map
+  /// before replacing the destination.
+  bool verify = true;
+  /// Skip files which are already at the target format version.
+  bool skip_current = true;
+};
+
+/// Results of upgrading one map file.
+struct ohm_API MapUpgradeResult
+{
+  /// Source map file.
+  std::string source;
+  /// Destination map file.
+  std::string destination;
+  /// Format version of the @c source file.
+  MapVersion source_version;
+  /// @c SerialisationError code: @c kSeOk on success.
+  int error = kSeOk;
+  /// Set if the @c source was already at the target version and @c MapUpgradeOptions::skip_current was set.
+  bool skipped = false;
+  /// Set if the upgraded map was verified against the source map.
+  bool verified = false;
+  /// Number of regions upgraded.
+  size_t region_count = 0;
+  /// Number of regions which failed verification.
+  size_t mismatched_regions = 0;
+  /// Time taken (seconds).
+  double seconds = 0;
+};
+
+/// Upgrade a map file in any loadable version to the current or indexed map format.
+///
+/// The @p source map is loaded in full - decoding legacy versions via the matching version handler - then saved to a
+/// temporary file beside @p destination . With @c MapUpgradeOptions::verify , the temporary file is then loaded and
+/// the content hash of each region layer compared against the loaded @p source map. The temporary file replaces
+/// @p destination only once saved and verified, so @p destination may be the same as @p source for an in place
+/// upgrade, and an interrupted or failed upgrade never leaves a partial @p destination .
+///
+/// @param source The map file to upgrade.
+/// @param destination The upgraded map file path.
+/// @param options Upgrade options.
+/// @param[out] result Optional detailed results.
+/// @return @c kSeOk on success, @c kSeVerifyFailure if verification fails, or another @c SerialisationError code.
+int ohm_API upgradeMap(const std::string &source, const std::string &destination,
+                       const MapUpgradeOptions &options = MapUpgradeOptions(), MapUpgradeResult *result = nullptr);
+
+/// Callback invoked by @c upgradeMaps() as each file completes. Calls are serialised.
+using MapUpgradeCallback = std::function<void(const MapUpgradeResult &)>;
+
+/// Upgrade a set of map files using @c upgradeMap() .
+///
+/// Files are upgraded concurrently when built with @c OHM_FEATURE_THREADS . Legacy map streams must be decoded
+/// sequentially, so converting many files at once is the main source of parallelism, while encoding and
+/// verification of each map are also parallel across regions.
+///
+/// @param files Pairs of source and destination file paths.
+/// @param options Upgrade options.
+/// @param[out] results Populated with the results for each file in the order of @p files .
+/// @param on_complete Optional callback invoked as each file completes.
+/// @return The number of files upgraded or skipped without error.
+size_t ohm_API upgradeMaps(const std::vector<std::pair<std::string, std::string>> &files,
+                           const MapUpgradeOptions &options, std::vector<MapUpgradeResult> &results,
+                           const MapUpgradeCallback &on_complete = MapUpgradeCallback());
+}  // namespace ohm
+
+#endif  // OHM_MAPUPGRADE_H
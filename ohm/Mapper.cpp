@@ -5,15 +5,163 @@
 // Author: Kazys Stepanas
 #include "Mapper.h"
 
+#include "MapLayout.h"
 #include "MappingProcess.h"
+#include "OccupancyMap.h"
+#include "TaskArena.h"
 
 #include "private/MapperDetail.h"
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
 #include <algorithm>
 #include <chrono>
 
 namespace ohm
 {
+namespace
+{
+#ifdef OHM_FEATURE_THREADS
+/// Declared layer dependencies for a @c MappingProcess .
+struct ProcessDependencies
+{
+  std::vector<int> read_layers;
+  std::vector<int> write_layers;
+  bool declared = false;
+};
+
+
+bool contains(const std::vector<int> &layers, int layer)
+{
+  return std::find(layers.begin(), layers.end(), layer) != layers.end();
+}
+
+
+/// Check if processes with dependencies @p a and @p b may not run concurrently.
+bool conflicts(const ProcessDependencies &a, const ProcessDependencies &b)
+{
+  if (!a.declared || !b.declared)
+  {
+    return true;
+  }
+
+  for (int layer : a.write_layers)
+  {
+    if (contains(b.read_layers, layer) || contains(b.write_layers, layer))
+    {
+      return true;
+    }
+  }
+
+  for (int layer : b.write_layers)
+  {
+    if (contains(a.read_layers, layer))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+int updateConcurrent(MapperDetail &imp, OccupancyMap &map, double time_slice_sec)
+{
+  using Clock = std::chrono::high_resolution_clock;
+  const Clock::time_point start_time = Clock::now();
+
+  const unsigned process_count = unsigned(imp.processes.size());
+  imp.next_process = imp.next_process % process_count;
+
+  // Prepare the map for all processes before any concurrent work. This may modify the map layout.
+  for (MappingProcess *process : imp.processes)
+  {
+    if (!process->paused())
+    {
+      process->prepareUpdate(map);
+    }
+  }
+
+  // Group processes into non-conflicting batches, starting at the next process for round robin fairness.
+  std::vector<ProcessDependencies> dependencies(process_count);
+  std::vector<std::vector<unsigned>> batches;
+  for (unsigned i = 0; i < process_count; ++i)
+  {
+    const unsigned process_index = (imp.next_process + i) % process_count;
+    MappingProcess *process = imp.processes[process_index];
+    if (process->paused())
+    {
+      continue;
+    }
+
+    ProcessDependencies &process_dependencies = dependencies[process_index];
+    process_dependencies.declared = process->layerDependencies(
+      map.layout(), process_dependencies.read_layers, process_dependencies.write_layers);
+
+    bool added = false;
+    for (auto &batch : batches)
+    {
+      const bool conflict = std::any_of(batch.begin(), batch.end(), [&](unsigned other_index) {
+        return conflicts(process_dependencies, dependencies[other_index]);
+      });
+      if (!conflict)
+      {
+        batch.emplace_back(process_index);
+        added = true;
+        break;
+      }
+    }
+
+    if (!added)
+    {
+      batches.emplace_back(1, process_index);
+    }
+  }
+  imp.next_process = (imp.next_process + 1) % process_count;
+
+  if (!imp.arena && imp.thread_count)
+  {
+    imp.arena = std::make_unique<tbb::task_arena>(int(imp.thread_count));
+  }
+
+  std::vector<int> results(process_count, kMprUpToDate);
+  double elapsed_sec = 0;
+  for (const auto &batch : batches)
+  {
+    if (time_slice_sec != 0 && elapsed_sec >= time_slice_sec)
+    {
+      break;
+    }
+
+    const double batch_time_slice = (time_slice_sec != 0) ? time_slice_sec - elapsed_sec : 0.0;
+    const auto update_batch = [&]() {
+      tbb::parallel_for(size_t(0), batch.size(), [&](size_t i) {
+        const unsigned process_index = batch[i];
+        results[process_index] = imp.processes[process_index]->update(map, batch_time_slice);
+      });
+    };
+    // Use the library task arena unless limited to an explicit thread count.
+    if (imp.arena)
+    {
+      imp.arena->execute(update_batch);
+    }
+    else
+    {
+      parallelExecute(update_batch);
+    }
+
+    const Clock::time_point cur_time = Clock::now();
+    elapsed_sec = std::chrono::duration_cast<std::chrono::duration<double>>(cur_time - start_time).count();
+  }
+
+  return *std::max_element(results.begin(), results.end());
+}
+#endif  // OHM_FEATURE_THREADS
+}  // namespace
+
+
 Mapper::Mapper(OccupancyMap *map)
   : imp_(std::make_unique<MapperDetail>())
 {
@@ -52,6 +200,13 @@ int Mapper::update(double time_slice_sec)
 
   OccupancyMap *map = this->map();
 
+#ifdef OHM_FEATURE_THREADS
+  if (imp_->concurrent && map && !imp_->processes.empty())
+  {
+    return updateConcurrent(*imp_, *map, time_slice_sec);
+  }
+#endif  // OHM_FEATURE_THREADS
+
   int status = kMprUpToDate;
   if (map && !imp_->processes.empty())
   {
@@ -86,10 +241,70 @@ int Mapper::update(double time_slice_sec)
 }
 
 
+void Mapper::setConcurrent(bool concurrent)
+{
+  imp_->concurrent = concurrent;
+}
+
+
+bool Mapper::concurrent() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return imp_->concurrent;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+void Mapper::setThreadCount(unsigned thread_count)
+{
+  if (thread_count != imp_->thread_count)
+  {
+    imp_->thread_count = thread_count;
+#ifdef OHM_FEATURE_THREADS
+    // Recreate on next use.
+    imp_->arena.reset();
+#endif  // OHM_FEATURE_THREADS
+  }
+}
+
+
+unsigned Mapper::threadCount() const
+{
+  return imp_->thread_count;
+}
+
+
+void Mapper::setReferencePosition(const glm::dvec3 &position)
+{
+  imp_->reference_position = position;
+  imp_->has_reference_position = true;
+  for (MappingProcess *process : imp_->processes)
+  {
+    process->setReferencePosition(position);
+  }
+}
+
+
+void Mapper::clearReferencePosition()
+{
+  imp_->has_reference_position = false;
+  for (MappingProcess *process : imp_->processes)
+  {
+    process->clearReferencePosition();
+  }
+}
+
+
 void Mapper::addProcess(MappingProcess *process)
 {
   // ASSERT(!hasProcess(process));
   // ASSERT(process);
+  if (imp_->has_reference_position)
+  {
+    process->setReferencePosition(imp_->reference_position);
+  }
   imp_->processes.push_back(process);
 }
 
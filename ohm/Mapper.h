@@ -8,6 +8,8 @@
 
 #include "OhmConfig.h"
 
+#include <glm/fwd.hpp>
+
 #include <memory>
 
 namespace ohm
@@ -37,6 +39,11 @@ class MappingProcess;
 ///   - Integrate new occupancy rays into the map.
 ///   - Update the @p Mapper, optionally with a time limit.
 ///
+/// The @c Mapper may optionally run processes concurrently - see @c setConcurrent() . Processes are then grouped into
+/// batches where no process writes a layer accessed by another process in the same batch, using the
+/// @c MappingProcess::layerDependencies() . Each batch is run in parallel on a dedicated thread arena, with batches run
+/// in sequence until the time slice is exceeded. Processes which do not declare their dependencies run on their own.
+///
 /// The @c Mapper is designed to be strongly associated with one @c OccupancyMap which does not change.
 class ohm_API Mapper
 {
@@ -61,6 +68,9 @@ public:
 
   /// Updates the @c Mapper giving each @c MappingProcess an opportunity to update.
   ///
+  /// When @c concurrent() , each batch of non-conflicting processes is updated in parallel and given the time slice
+  /// remaining when the batch starts. The first process considered for batching rotates with each call.
+  ///
   /// Each @c MappingProcess is updated in turn until the @c timeSliceSec is exceeded. This process tracks the last
   /// @c MappingProcess updated, so the next call to this @c update() will target the next @c MappingProcess in
   /// the list. This ensures each process has the same opportunity to run.
@@ -74,6 +84,34 @@ public:
   /// @return The overall status. See @c MappingProcessResult.
   int update(double time_slice_sec);
 
+  /// Enable or disable concurrent execution of @c MappingProcess objects. Requires @c OHM_FEATURE_THREADS , otherwise
+  /// processes are always updated serially.
+  /// @param concurrent True to enable concurrent updates.
+  void setConcurrent(bool concurrent);
+
+  /// Is concurrent execution of @c MappingProcess objects enabled? Always false when not built with
+  /// @c OHM_FEATURE_THREADS .
+  /// @return True if concurrent updates are enabled.
+  bool concurrent() const;
+
+  /// Set the maximum number of threads used for concurrent updates.
+  /// @param thread_count The maximum number of threads. Zero to use the library @c taskArena() or default concurrency.
+  void setThreadCount(unsigned thread_count);
+
+  /// Query the maximum number of threads used for concurrent updates.
+  /// @return The maximum number of threads, or zero for the default concurrency.
+  unsigned threadCount() const;
+
+  /// Set the reference position for all @c MappingProcess objects, both current and subsequently added. This is
+  /// generally the current robot position, which processes use to prioritise updates nearby.
+  ///
+  /// @param position The reference position in the map frame.
+  /// @see @c MappingProcess::setReferencePosition()
+  void setReferencePosition(const glm::dvec3 &position);
+
+  /// Clear the reference position for all @c MappingProcess objects.
+  void clearReferencePosition();
+
   /// Adds @p process to the update list. The @c Mapper takes ownership of the pointer. The specific @p process
   /// must not already be registered in this or any other @c Mapper.
   ///
@@ -10,4 +10,15 @@ namespace ohm
 MappingProcess::MappingProcess() = default;
 
 MappingProcess::~MappingProcess() = default;
+
+
+bool MappingProcess::layerDependencies(const MapLayout & /*layout*/, std::vector<int> & /*read_layers*/,
+                                       std::vector<int> & /*write_layers*/) const
+{
+  return false;
+}
+
+
+void MappingProcess::prepareUpdate(OccupancyMap & /*map*/)
+{}
 }  // namespace ohm
@@ -8,8 +8,13 @@
 
 #include "OhmConfig.h"
 
+#include <glm/vec3.hpp>
+
+#include <vector>
+
 namespace ohm
 {
+class MapLayout;
 class OccupancyMap;
 
 /// Return value for @c Mapper::update() and @c MappingProcess::update(). Values must be ordered
@@ -25,10 +30,18 @@ enum MappingProcessResult
 
 /// Base class for processes to be added to the @p Mapper for processing during map update.
 ///
+/// A process may be given a @c referencePosition() , generally the current robot position. Processes which work on a
+/// region basis should use this to prioritise regions near the reference position, ensuring the navigation critical
+/// neighbourhood is updated first. See @c RegionScheduler .
+///
+/// A process may also declare the map layers it reads and writes via @c layerDependencies() . This allows a
+/// concurrent @c Mapper to run processes with no conflicting layers in parallel. A process which does not declare its
+/// dependencies is never run concurrently with another process.
+///
 /// @note This class and all derivations are experimental.
 ///
 /// @todo Features to consider:
-/// - Update period and scheduling
+/// - Update period
 /// - Update only on dirty?
 class ohm_API MappingProcess
 {
@@ -45,6 +58,41 @@ public:
   /// @return True if paused.
   inline bool paused() const { return paused_; }
 
+  /// Set the reference position used to prioritise updates. Must be in the same frame as the target map.
+  /// @param position The reference position, generally the robot position.
+  inline void setReferencePosition(const glm::dvec3 &position)
+  {
+    reference_position_ = position;
+    has_reference_position_ = true;
+  }
+  /// Clear the reference position, reverting to the default update order.
+  inline void clearReferencePosition() { has_reference_position_ = false; }
+  /// Query the reference position. Only valid when @c hasReferencePosition() is true.
+  /// @return The reference position.
+  inline const glm::dvec3 &referencePosition() const { return reference_position_; }
+  /// Has a reference position been set?
+  /// @return True if a reference position has been set.
+  inline bool hasReferencePosition() const { return has_reference_position_; }
+
+  /// Declare the map layers read and written by @c update() . Concurrent @c update() calls are only made for processes
+  /// where no process writes a layer accessed by another.
+  ///
+  /// The default implementation declares no dependencies, which prevents concurrent updates.
+  ///
+  /// @param layout The layout of the map to be updated.
+  /// @param[out] read_layers Populated with the indices of the layers read by the process.
+  /// @param[out] write_layers Populated with the indices of the layers written by the process.
+  /// @return True if the dependencies have been declared and the process supports concurrent updates.
+  virtual bool layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                                 std::vector<int> &write_layers) const;
+
+  /// Prepare @p map for an @c update() , such as by adding the layers required by the process. This is called before
+  /// concurrent updates and is never itself called concurrently.
+  ///
+  /// The default implementation does nothing.
+  /// @param map The map to be updated.
+  virtual void prepareUpdate(OccupancyMap &map);
+
   /// Request a reset of the process. Must drop and reinitialise all data.
   virtual void reset() = 0;
 
@@ -54,7 +102,9 @@ public:
   virtual int update(OccupancyMap &map, double time_slice) = 0;
 
 private:
+  glm::dvec3 reference_position_{ 0.0 };
   bool paused_ = false;
+  bool has_reference_position_ = false;
 };
 }  // namespace ohm
 
@@ -0,0 +1,108 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MemoryTrack.h"
+
+#include <array>
+#include <atomic>
+
+namespace ohm
+{
+namespace memorytrack
+{
+namespace
+{
+struct SubsystemCounters
+{
+  std::atomic<size_t> current_bytes{ 0 };
+  std::atomic<size_t> peak_bytes{ 0 };
+  std::atomic<uint64_t> allocations{ 0 };
+  std::atomic<uint64_t> allocated_bytes{ 0 };
+};
+
+using CounterArray = std::array<SubsystemCounters, unsigned(MemorySubsystem::kCount)>;
+
+CounterArray &counters()
+{
+  static CounterArray counter_array;
+  return counter_array;
+}
+}  // namespace
+
+
+const char *subsystemName(MemorySubsystem subsystem)
+{
+  switch (subsystem)
+  {
+  case MemorySubsystem::kCompression:
+    return "compression";
+  case MemorySubsystem::kGpuStaging:
+    return "gpu_staging";
+  case MemorySubsystem::kKeyList:
+    return "key_list";
+  default:
+    break;
+  }
+  return "<unknown>";
+}
+
+
+MemorySubsystemStats stats(MemorySubsystem subsystem)
+{
+  MemorySubsystemStats subsystem_stats;
+  if (subsystem < MemorySubsystem::kCount)
+  {
+    const SubsystemCounters &subsystem_counters = counters()[unsigned(subsystem)];
+    subsystem_stats.current_bytes = subsystem_counters.current_bytes;
+    subsystem_stats.peak_bytes = subsystem_counters.peak_bytes;
+    subsystem_stats.allocations = subsystem_counters.allocations;
+    subsystem_stats.allocated_bytes = subsystem_counters.allocated_bytes;
+  }
+  return subsystem_stats;
+}
+
+
+void resetPeaks()
+{
+  for (SubsystemCounters &subsystem_counters : counters())
+  {
+    subsystem_counters.peak_bytes = subsystem_counters.current_bytes.load();
+  }
+}
+
+
+void resetCounts()
+{
+  for (SubsystemCounters &subsystem_counters : counters())
+  {
+    subsystem_counters.allocations = 0u;
+    subsystem_counters.allocated_bytes = 0u;
+  }
+}
+
+
+void recordResize(MemorySubsystem subsystem, size_t old_bytes, size_t new_bytes)
+{
+  if (subsystem >= MemorySubsystem::kCount || old_bytes == new_bytes)
+  {
+    return;
+  }
+
+  SubsystemCounters &subsystem_counters = counters()[unsigned(subsystem)];
+  if (new_bytes)
+  {
+    subsystem_counters.allocations.fetch_add(1u, std::memory_order_relaxed);
+    subsystem_counters.allocated_bytes.fetch_add(new_bytes, std::memory_order_relaxed);
+  }
+
+  // Unsigned wrap around applies a decrease.
+  const size_t current = subsystem_counters.current_bytes.fetch_add(new_bytes - old_bytes) + (new_bytes - old_bytes);
+  size_t peak = subsystem_counters.peak_bytes;
+  while (current > peak && !subsystem_counters.peak_bytes.compare_exchange_weak(peak, current))
+  {
+  }
+}
+}  // namespace memorytrack
+}  // namespace ohm
@@ -0,0 +1,177 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MEMORYTRACK_H
+#define OHM_MEMORYTRACK_H
+
+#include "OhmConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+/// Subsystems with working memory tracked by @c memorytrack .
+///
+/// Voxel memory is not included here as it is accounted for each map and layer by @c MapMemoryAccounting .
+enum class MemorySubsystem : unsigned
+{
+  /// Compression buffers used by the @c VoxelBlockCompressionQueue and @c OccupancyMap::enforceMemoryBudget() .
+  kCompression,
+  /// Host staging memory for GPU transfers, such as the @c GpuLayerCache packed occupancy and region table staging.
+  kGpuStaging,
+  /// @c KeyList storage; mostly ray traversal temporaries.
+  kKeyList,
+  /// Number of subsystems.
+  kCount
+};
+
+/// Memory statistics for a @c MemorySubsystem . See @c memorytrack::stats() .
+struct ohm_API MemorySubsystemStats
+{
+  /// Bytes currently allocated.
+  size_t current_bytes = 0;
+  /// Highest @c current_bytes since the last @c memorytrack::resetPeaks() .
+  size_t peak_bytes = 0;
+  /// Number of allocations since the last @c memorytrack::resetCounts() .
+  uint64_t allocations = 0;
+  /// Total bytes of the allocations since the last @c memorytrack::resetCounts() .
+  uint64_t allocated_bytes = 0;
+};
+
+/// Process wide tracking of the working memory of ohm subsystems, by @c MemorySubsystem .
+///
+/// Tracking is only active when built with @c OHM_MEMORY_TRACK - see @c kEnabled . Otherwise the @c BufferTracker
+/// compiles to nothing and all @c stats() are zero. Tracking is by buffer capacity at the points where buffers may
+/// grow, so transient growth between those points is not seen. Counters are atomic and may be updated from any thread.
+namespace memorytrack
+{
+#ifdef OHM_MEMORY_TRACK
+/// True when memory tracking is built in.
+constexpr bool kEnabled = true;
+#else   // OHM_MEMORY_TRACK
+/// True when memory tracking is built in.
+constexpr bool kEnabled = false;
+#endif  // OHM_MEMORY_TRACK
+
+/// Query a display name for @p subsystem .
+/// @param subsystem The subsystem of interest.
+/// @return The subsystem name, such as "key_list".
+const char ohm_API *subsystemName(MemorySubsystem subsystem);
+
+/// Query the statistics for @p subsystem .
+/// @param subsystem The subsystem of interest.
+/// @return The current statistics.
+MemorySubsystemStats ohm_API stats(MemorySubsystem subsystem);
+
+/// Reset the @c MemorySubsystemStats::peak_bytes of all subsystems to their current bytes.
+void ohm_API resetPeaks();
+
+/// Reset the @c MemorySubsystemStats::allocations and @c MemorySubsystemStats::allocated_bytes of all subsystems.
+void ohm_API resetCounts();
+
+/// Record a change in the allocated size of a buffer for @p subsystem . A change to a non zero size is counted as an
+/// allocation. Prefer a @c BufferTracker .
+/// @param subsystem The owning subsystem.
+/// @param old_bytes The previous buffer size (bytes).
+/// @param new_bytes The new buffer size (bytes).
+void ohm_API recordResize(MemorySubsystem subsystem, size_t old_bytes, size_t new_bytes);
+
+/// Tracks the allocated size of a single buffer for a @c MemorySubsystem . Owners call @c track() or @c update()
+/// after operations which may reallocate the buffer, while the destructor releases the tracked size.
+///
+/// Copying a tracker records an allocation of the same size for the copy, as for copying the buffer, while moving
+/// transfers the tracked size. Owners should call @c track() after copy assignment to record the actual capacity.
+///
+/// The tracker has the same layout regardless of @c kEnabled , but does nothing when tracking is not built in.
+class BufferTracker
+{
+public:
+  /// Constructor.
+  /// @param subsystem The subsystem owning the buffer.
+  inline explicit BufferTracker(MemorySubsystem subsystem)
+    : subsystem_(subsystem)
+  {}
+
+  /// Copy constructor.
+  /// @param other The tracker to copy.
+  inline BufferTracker(const BufferTracker &other)
+    : subsystem_(other.subsystem_)
+  {
+    update(other.bytes_);
+  }
+
+  /// Move constructor.
+  /// @param other The tracker to move.
+  inline BufferTracker(BufferTracker &&other) noexcept
+    : subsystem_(other.subsystem_)
+    , bytes_(other.bytes_)
+  {
+    other.bytes_ = 0;
+  }
+
+  /// Destructor: records the release of the buffer.
+  inline ~BufferTracker() { update(0); }
+
+  /// Copy assignment. Retains the current subsystem.
+  /// @param other The tracker to copy.
+  /// @return @c *this
+  inline BufferTracker &operator=(const BufferTracker &other)
+  {
+    update(other.bytes_);
+    return *this;
+  }
+
+  /// Move assignment, releasing the current buffer and taking the tracked size from @p other . Both trackers should
+  /// track the same subsystem.
+  /// @param other The tracker to move.
+  /// @return @c *this
+  inline BufferTracker &operator=(BufferTracker &&other) noexcept
+  {
+    if (this != &other)
+    {
+      update(0);
+      bytes_ = other.bytes_;
+      other.bytes_ = 0;
+    }
+    return *this;
+  }
+
+  /// Query the tracked buffer size.
+  /// @return The tracked size (bytes). Always zero when tracking is not built in.
+  inline size_t bytes() const { return bytes_; }
+
+  /// Update the tracked buffer size.
+  /// @param bytes The current buffer size (bytes).
+  inline void update(size_t bytes)
+  {
+#ifdef OHM_MEMORY_TRACK
+    if (bytes != bytes_)
+    {
+      recordResize(subsystem_, bytes_, bytes);
+      bytes_ = bytes;
+    }
+#else   // OHM_MEMORY_TRACK
+    (void)bytes;
+#endif  // OHM_MEMORY_TRACK
+  }
+
+  /// Update the tracked size from the capacity of @p buffer .
+  /// @param buffer The tracked buffer.
+  template <typename T, typename Alloc>
+  inline void track(const std::vector<T, Alloc> &buffer)
+  {
+    update(buffer.capacity() * sizeof(T));
+  }
+
+private:
+  MemorySubsystem subsystem_;
+  size_t bytes_ = 0;
+};
+}  // namespace memorytrack
+}  // namespace ohm
+
+#endif  // OHM_MEMORYTRACK_H
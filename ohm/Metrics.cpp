@@ -0,0 +1,352 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "Metrics.h"
+
+#include <algorithm>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace ohm
+{
+namespace metrics
+{
+namespace
+{
+const char *typeName(Metric::Type type)
+{
+  switch (type)
+  {
+  case Metric::Type::kCounter:
+    return "counter";
+  case Metric::Type::kGauge:
+    return "gauge";
+  case Metric::Type::kHistogram:
+    return "histogram";
+  default:
+    break;
+  }
+  return "untyped";
+}
+
+
+void writeHeader(std::ostream &out, const Metric &metric)
+{
+  if (!metric.help().empty())
+  {
+    out << "# HELP " << metric.name() << ' ' << metric.help() << '\n';
+  }
+  out << "# TYPE " << metric.name() << ' ' << typeName(metric.type()) << '\n';
+}
+
+
+/// Format a sample value, using the Prometheus spelling for infinite values.
+std::string formatValue(double value)
+{
+  if (value == std::numeric_limits<double>::infinity())
+  {
+    return "+Inf";
+  }
+  if (value == -std::numeric_limits<double>::infinity())
+  {
+    return "-Inf";
+  }
+  std::ostringstream str;
+  str.precision(std::numeric_limits<double>::max_digits10);
+  str << value;
+  return str.str();
+}
+
+
+void atomicAdd(std::atomic<double> &target, double value)
+{
+  double current = target.load(std::memory_order_relaxed);
+  while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+  {
+  }
+}
+}  // namespace
+
+
+unsigned threadShard()
+{
+  static std::atomic<unsigned> next_shard(0);
+  thread_local const unsigned shard = next_shard++ % kShardCount;
+  return shard;
+}
+
+
+Metric::Metric(Type type, std::string name, std::string help)
+  : type_(type)
+  , name_(std::move(name))
+  , help_(std::move(help))
+{}
+
+
+Metric::~Metric() = default;
+
+
+Counter::Counter(std::string name, std::string help)
+  : Metric(Type::kCounter, std::move(name), std::move(help))
+{}
+
+
+uint64_t Counter::value() const
+{
+  uint64_t total = 0;
+  for (const Shard &shard : shards_)
+  {
+    total += shard.value.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+
+void Counter::writePrometheus(std::ostream &out) const
+{
+  writeHeader(out, *this);
+  out << name() << ' ' << value() << '\n';
+}
+
+
+void Counter::reset()
+{
+  for (Shard &shard : shards_)
+  {
+    shard.value = 0;
+  }
+}
+
+
+Gauge::Gauge(std::string name, std::string help)
+  : Metric(Type::kGauge, std::move(name), std::move(help))
+{}
+
+
+void Gauge::writePrometheus(std::ostream &out) const
+{
+  writeHeader(out, *this);
+  out << name() << ' ' << formatValue(value()) << '\n';
+}
+
+
+void Gauge::reset()
+{
+  set(0);
+}
+
+
+Histogram::Histogram(std::string name, std::string help, std::vector<double> bounds)
+  : Metric(Type::kHistogram, std::move(name), std::move(help))
+  , bounds_(std::move(bounds))
+{
+  std::sort(bounds_.begin(), bounds_.end());
+  for (Shard &shard : shards_)
+  {
+    shard.counts = std::make_unique<std::atomic<uint64_t>[]>(bounds_.size() + 1);
+    for (size_t i = 0; i <= bounds_.size(); ++i)
+    {
+      shard.counts[i] = 0;
+    }
+  }
+}
+
+
+Histogram::~Histogram() = default;
+
+
+void Histogram::observe(double value)
+{
+  const size_t bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+  Shard &shard = shards_[threadShard()];
+  shard.counts[bucket].fetch_add(1u, std::memory_order_relaxed);
+  atomicAdd(shard.sum, value);
+}
+
+
+uint64_t Histogram::count() const
+{
+  uint64_t total = 0;
+  for (const Shard &shard : shards_)
+  {
+    for (size_t i = 0; i <= bounds_.size(); ++i)
+    {
+      total += shard.counts[i].load(std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+
+double Histogram::sum() const
+{
+  double total = 0;
+  for (const Shard &shard : shards_)
+  {
+    total += shard.sum.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+
+void Histogram::bucketCounts(std::vector<uint64_t> &counts) const
+{
+  counts.clear();
+  counts.resize(bounds_.size() + 1, 0u);
+  for (const Shard &shard : shards_)
+  {
+    for (size_t i = 0; i <= bounds_.size(); ++i)
+    {
+      counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+
+void Histogram::writePrometheus(std::ostream &out) const
+{
+  writeHeader(out, *this);
+  std::vector<uint64_t> counts;
+  bucketCounts(counts);
+  // Prometheus buckets are cumulative.
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < bounds_.size(); ++i)
+  {
+    cumulative += counts[i];
+    out << name() << "_bucket{le=\"" << formatValue(bounds_[i]) << "\"} " << cumulative << '\n';
+  }
+  cumulative += counts.back();
+  out << name() << "_bucket{le=\"+Inf\"} " << cumulative << '\n';
+  out << name() << "_sum " << formatValue(sum()) << '\n';
+  out << name() << "_count " << cumulative << '\n';
+}
+
+
+void Histogram::reset()
+{
+  for (Shard &shard : shards_)
+  {
+    for (size_t i = 0; i <= bounds_.size(); ++i)
+    {
+      shard.counts[i] = 0;
+    }
+    shard.sum = 0;
+  }
+}
+
+
+Registry::Registry() = default;
+
+
+Registry::~Registry() = default;
+
+
+Registry &Registry::global()
+{
+  static Registry registry;
+  return registry;
+}
+
+
+template <typename T, typename... Args>
+T &Registry::findOrAdd(Metric::Type type, const std::string &name, Args &&...args)
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  for (const auto &metric : metrics_)
+  {
+    if (metric->name() == name)
+    {
+      if (metric->type() != type)
+      {
+        throw std::runtime_error("Metric " + name + " already registered as a " + typeName(metric->type()));
+      }
+      return static_cast<T &>(*metric);
+    }
+  }
+
+  metrics_.emplace_back(std::make_unique<T>(name, std::forward<Args>(args)...));
+  return static_cast<T &>(*metrics_.back());
+}
+
+
+Counter &Registry::counter(const std::string &name, const std::string &help)
+{
+  return findOrAdd<Counter>(Metric::Type::kCounter, name, help);
+}
+
+
+Gauge &Registry::gauge(const std::string &name, const std::string &help)
+{
+  return findOrAdd<Gauge>(Metric::Type::kGauge, name, help);
+}
+
+
+Histogram &Registry::histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds)
+{
+  return findOrAdd<Histogram>(Metric::Type::kHistogram, name, help, bounds);
+}
+
+
+const Metric *Registry::find(const std::string &name) const
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  for (const auto &metric : metrics_)
+  {
+    if (metric->name() == name)
+    {
+      return metric.get();
+    }
+  }
+  return nullptr;
+}
+
+
+void Registry::writePrometheus(std::ostream &out) const
+{
+  std::vector<const Metric *> metrics;
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    metrics.reserve(metrics_.size());
+    for (const auto &metric : metrics_)
+    {
+      metrics.emplace_back(metric.get());
+    }
+  }
+
+  // Metrics are never removed, so they may be written without holding the lock.
+  std::sort(metrics.begin(), metrics.end(),
+            [](const Metric *a, const Metric *b) { return a->name() < b->name(); });
+  for (const Metric *metric : metrics)
+  {
+    metric->writePrometheus(out);
+  }
+}
+
+
+void Registry::reset()
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  for (const auto &metric : metrics_)
+  {
+    metric->reset();
+  }
+}
+
+
+const CoreMetrics &coreMetrics()
+{
+  static const CoreMetrics core_metrics = {
+    Registry::global().counter("ohm_rays_integrated_total", "Rays given to the CPU ray mappers."),
+    Registry::global().counter("ohm_rays_filtered_total", "Rays rejected by the map ray filter."),
+    Registry::global().counter("ohm_regions_created_total", "Map regions created."),
+    Registry::global().histogram("ohm_integrate_rays_seconds", "Duration of occupancy ray integration calls.",
+                                 { 1e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1.0 })
+  };
+  return core_metrics;
+}
+}  // namespace metrics
+}  // namespace ohm
@@ -0,0 +1,266 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_METRICS_H
+#define OHM_METRICS_H
+
+#include "OhmConfig.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+/// Lock free runtime metrics, which may be read while they are being updated.
+///
+/// Metrics are registered by name in a @c Registry , typically the @c Registry::global() instance, and the returned
+/// references remain valid for the life of the registry. Counters and histograms are sharded per thread so hot path
+/// updates from multiple threads do not contend on the same cache line. Reading a metric sums the shards.
+///
+/// Metric names should follow the Prometheus conventions - `[a-zA-Z_:][a-zA-Z0-9_:]*` - as
+/// @c Registry::writePrometheus() writes the metrics in the Prometheus text exposition format.
+///
+/// @code
+/// static ohm::metrics::Counter &rays = ohm::metrics::Registry::global().counter("rays_total", "Rays processed.");
+/// rays.add(ray_count);
+/// @endcode
+namespace metrics
+{
+/// Number of shards for each sharded metric.
+constexpr unsigned kShardCount = 16u;
+
+/// Select the shard index for the current thread. Threads are assigned shards round robin.
+/// @return The shard index [0, @c kShardCount ).
+unsigned ohm_API threadShard();
+
+/// Base class for a named metric.
+class ohm_API Metric
+{
+public:
+  /// Metric type.
+  enum class Type
+  {
+    kCounter,
+    kGauge,
+    kHistogram
+  };
+
+  /// Constructor.
+  /// @param type The metric type.
+  /// @param name The metric name.
+  /// @param help Metric description.
+  Metric(Type type, std::string name, std::string help);
+  /// Virtual destructor.
+  virtual ~Metric();
+
+  Metric(const Metric &) = delete;
+  Metric &operator=(const Metric &) = delete;
+
+  /// Query the metric type.
+  /// @return The metric type.
+  inline Type type() const { return type_; }
+  /// Query the metric name.
+  /// @return The metric name.
+  inline const std::string &name() const { return name_; }
+  /// Query the metric description.
+  /// @return The metric help string.
+  inline const std::string &help() const { return help_; }
+
+  /// Write the metric samples in the Prometheus text format, including the @c # @c HELP and @c # @c TYPE lines.
+  /// @param out The stream to write to.
+  virtual void writePrometheus(std::ostream &out) const = 0;
+
+  /// Reset the metric to zero. Not synchronised with concurrent updates.
+  virtual void reset() = 0;
+
+private:
+  Type type_;
+  std::string name_;
+  std::string help_;
+};
+
+/// A monotonic counter.
+class ohm_API Counter : public Metric
+{
+public:
+  /// Constructor.
+  /// @param name The metric name.
+  /// @param help Metric description.
+  Counter(std::string name, std::string help);
+
+  /// Increment the counter.
+  /// @param value The value to add.
+  inline void add(uint64_t value = 1u) { shards_[threadShard()].value.fetch_add(value, std::memory_order_relaxed); }
+
+  /// Query the current counter value.
+  /// @return The sum of the counter shards.
+  uint64_t value() const;
+
+  void writePrometheus(std::ostream &out) const override;
+  void reset() override;
+
+private:
+  /// A counter shard on its own cache line.
+  struct alignas(64) Shard
+  {
+    std::atomic<uint64_t> value{ 0 };
+  };
+
+  std::array<Shard, kShardCount> shards_;
+};
+
+/// A gauge holding the last set value.
+class ohm_API Gauge : public Metric
+{
+public:
+  /// Constructor.
+  /// @param name The metric name.
+  /// @param help Metric description.
+  Gauge(std::string name, std::string help);
+
+  /// Set the gauge value.
+  /// @param value The new value.
+  inline void set(double value) { value_.store(value, std::memory_order_relaxed); }
+
+  /// Query the current gauge value.
+  /// @return The last set value.
+  inline double value() const { return value_.load(std::memory_order_relaxed); }
+
+  void writePrometheus(std::ostream &out) const override;
+  void reset() override;
+
+private:
+  std::atomic<double> value_{ 0 };
+};
+
+/// A histogram of observed values with fixed bucket upper bounds.
+class ohm_API Histogram : public Metric
+{
+public:
+  /// Constructor.
+  /// @param name The metric name.
+  /// @param help Metric description.
+  /// @param bounds Inclusive upper bounds of the buckets in ascending order. An implicit +Inf bucket is added.
+  Histogram(std::string name, std::string help, std::vector<double> bounds);
+  /// Destructor.
+  ~Histogram() override;
+
+  /// Record an observation.
+  /// @param value The observed value.
+  void observe(double value);
+
+  /// Query the bucket upper bounds, excluding the implicit +Inf bucket.
+  /// @return The bucket bounds.
+  inline const std::vector<double> &bounds() const { return bounds_; }
+
+  /// Query the total number of observations.
+  /// @return The observation count.
+  uint64_t count() const;
+
+  /// Query the sum of all observations.
+  /// @return The observation sum.
+  double sum() const;
+
+  /// Query the number of observations in each bucket, not cumulative.
+  /// @param[out] counts Set to the bucket counts, with the +Inf bucket last.
+  void bucketCounts(std::vector<uint64_t> &counts) const;
+
+  void writePrometheus(std::ostream &out) const override;
+  void reset() override;
+
+private:
+  /// A histogram shard on its own cache line.
+  struct alignas(64) Shard
+  {
+    std::atomic<double> sum{ 0 };
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+  };
+
+  std::vector<double> bounds_;
+  std::array<Shard, kShardCount> shards_;
+};
+
+/// A registry of named metrics.
+class ohm_API Registry
+{
+public:
+  /// Constructor.
+  Registry();
+  /// Destructor.
+  ~Registry();
+
+  Registry(const Registry &) = delete;
+  Registry &operator=(const Registry &) = delete;
+
+  /// Access the process wide registry used by the ohm libraries.
+  /// @return The global registry.
+  static Registry &global();
+
+  /// Find or register a @c Counter . Registration is synchronised, so callers should cache the result.
+  /// @param name The metric name.
+  /// @param help Metric description. Ignored when the metric already exists.
+  /// @return The counter. Throws @c std::runtime_error if @p name is registered as another metric type.
+  Counter &counter(const std::string &name, const std::string &help);
+
+  /// Find or register a @c Gauge .
+  /// @param name The metric name.
+  /// @param help Metric description. Ignored when the metric already exists.
+  /// @return The gauge. Throws @c std::runtime_error if @p name is registered as another metric type.
+  Gauge &gauge(const std::string &name, const std::string &help);
+
+  /// Find or register a @c Histogram .
+  /// @param name The metric name.
+  /// @param help Metric description. Ignored when the metric already exists.
+  /// @param bounds Bucket upper bounds. Ignored when the metric already exists.
+  /// @return The histogram. Throws @c std::runtime_error if @p name is registered as another metric type.
+  Histogram &histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds);
+
+  /// Find a registered metric.
+  /// @param name The metric name.
+  /// @return The metric or null if not registered.
+  const Metric *find(const std::string &name) const;
+
+  /// Write all metrics in the Prometheus text exposition format, sorted by name. Safe to call while metrics are
+  /// updated.
+  /// @param out The stream to write to.
+  void writePrometheus(std::ostream &out) const;
+
+  /// Reset all metrics to zero. Not synchronised with concurrent metric updates.
+  void reset();
+
+private:
+  template <typename T, typename... Args>
+  T &findOrAdd(Metric::Type type, const std::string &name, Args &&...args);
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Metric>> metrics_;
+};
+
+/// The metrics updated by the ohm library, registered in @c Registry::global() .
+struct ohm_API CoreMetrics
+{
+  /// `ohm_rays_integrated_total` : rays given to the CPU @c RayMapper implementations.
+  Counter &rays_integrated;
+  /// `ohm_rays_filtered_total` : rays rejected by the @c OccupancyMap::rayFilter() .
+  Counter &rays_filtered;
+  /// `ohm_regions_created_total` : @c MapChunk regions created in any @c OccupancyMap .
+  Counter &regions_created;
+  /// `ohm_integrate_rays_seconds` : duration of each @c RayMapperOccupancy::integrateRays() call.
+  Histogram &integrate_rays_seconds;
+};
+
+/// Access the @c CoreMetrics , registering them on the first call.
+/// @return The core metrics.
+const CoreMetrics ohm_API &coreMetrics();
+}  // namespace metrics
+}  // namespace ohm
+
+#endif  // OHM_METRICS_H
@@ -115,7 +115,7 @@ void NdtMap::setNdtSampleThreshold(unsigned sample_count)
 }
 
 
-unsigned NdtMap::ndtSampleThreshold()
+unsigned NdtMap::ndtSampleThreshold() const
 {
   return imp_->sample_threshold;
 }
@@ -160,6 +160,18 @@ float NdtMap::initialIntensityCovariance() const
 }
 
 
+void NdtMap::setSinglePrecisionCovariance(bool single_precision)
+{
+  imp_->single_precision_covariance = single_precision;
+}
+
+
+bool NdtMap::singlePrecisionCovariance() const
+{
+  return imp_->single_precision_covariance;
+}
+
+
 void NdtMap::setTrace(bool trace)
 {
   imp_->trace = trace;
@@ -80,7 +80,7 @@ public:
   /// Set the number of samples required in a voxel before using the NDT algorithm for @c integateMiss() adjustments.
   void setNdtSampleThreshold(unsigned sample_count);
   /// Get the number of samples required in a voxel before using the NDT algorithm for @c integateMiss() adjustments.
-  unsigned ndtSampleThreshold();
+  unsigned ndtSampleThreshold() const;
 
   /// Set the occupancy threshold value at which the covariance matrix may be reinitialised.
   ///
@@ -112,6 +112,15 @@ public:
   /// Read the intensity covariance upon initialisation.
   float initialIntensityCovariance() const;
 
+  /// Set whether the @c RayMapperNdt uses single precision maths for the sample voxel covariance update. This is
+  /// faster than the default double precision update, with results matching to within single precision rounding. See
+  /// @c calculateHitWithCovarianceBatch() . This setting is not serialised.
+  /// @param single_precision True to use single precision maths.
+  void setSinglePrecisionCovariance(bool single_precision);
+  /// Query whether single precision maths is used for the covariance update. See @c setSinglePrecisionCovariance()
+  /// @return True if using single precision maths.
+  bool singlePrecisionCovariance() const;
+
   /// Enable detailed tracing via 3rd Eye Scene.
   /// @param trace True to enable tracing.
   void setTrace(bool trace);
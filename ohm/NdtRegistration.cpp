@@ -0,0 +1,667 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "NdtRegistration.h"
+
+#include "CovarianceVoxel.h"
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "MapRegion.h"
+#include "NdtMap.h"
+#include "OccupancyMap.h"
+#include "TaskArena.h"
+#include "VoxelBuffer.h"
+#include "VoxelMean.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrder.h"
+
+#include <glm/glm.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ohm
+{
+namespace
+{
+/// Number of points evaluated as one unit of work. Partial results are summed in block order so the results do not
+/// depend on threading.
+const size_t kPointBlockSize = 256u;
+
+/// A normal distribution cached from the NDT layers of a voxel.
+struct NdtDistribution
+{
+  glm::dvec3 mean;
+  glm::dmat3 inverse_covariance;
+};
+
+/// The distributions for a single region.
+struct RegionDistributions
+{
+  /// The most recent touch stamp of the layers used in the build.
+  uint64_t stamp = 0;
+  /// Index into @c distributions for each voxel, in row major order, or -1 where there is no distribution.
+  std::vector<int> voxel_distribution;
+  std::vector<NdtDistribution> distributions;
+};
+
+using RegionDistributionMap = std::unordered_map<glm::i16vec3, std::unique_ptr<RegionDistributions>, MapRegion::Hash>;
+
+/// Construct a 3x3 matrix from rows.
+inline glm::dmat3 fromRows(const glm::dvec3 &row0, const glm::dvec3 &row1, const glm::dvec3 &row2)
+{
+  return glm::transpose(glm::dmat3(row0, row1, row2));
+}
+
+/// Rotation matrices and their derivatives with respect to the pose angles.
+struct PoseDerivatives
+{
+  glm::dmat3 rotation;
+  /// First derivatives with respect to roll, pitch and yaw.
+  std::array<glm::dmat3, 3> first;
+  /// Second derivatives indexed `[i][j]` for angles i, j. Symmetric.
+  std::array<std::array<glm::dmat3, 3>, 3> second;
+
+  explicit PoseDerivatives(const NdtPose &pose)
+  {
+    const double sa = std::sin(pose[3]);
+    const double ca = std::cos(pose[3]);
+    const double sb = std::sin(pose[4]);
+    const double cb = std::cos(pose[4]);
+    const double sc = std::sin(pose[5]);
+    const double cc = std::cos(pose[5]);
+
+    // Rotation about each axis (r), with first (d) and second (dd) derivatives.
+    const glm::dmat3 rx = fromRows(glm::dvec3(1, 0, 0), glm::dvec3(0, ca, -sa), glm::dvec3(0, sa, ca));
+    const glm::dmat3 drx = fromRows(glm::dvec3(0, 0, 0), glm::dvec3(0, -sa, -ca), glm::dvec3(0, ca, -sa));
+    const glm::dmat3 ddrx = fromRows(glm::dvec3(0, 0, 0), glm::dvec3(0, -ca, sa), glm::dvec3(0, -sa, -ca));
+    const glm::dmat3 ry = fromRows(glm::dvec3(cb, 0, sb), glm::dvec3(0, 1, 0), glm::dvec3(-sb, 0, cb));
+    const glm::dmat3 dry = fromRows(glm::dvec3(-sb, 0, cb), glm::dvec3(0, 0, 0), glm::dvec3(-cb, 0, -sb));
+    const glm::dmat3 ddry = fromRows(glm::dvec3(-cb, 0, -sb), glm::dvec3(0, 0, 0), glm::dvec3(sb, 0, -cb));
+    const glm::dmat3 rz = fromRows(glm::dvec3(cc, -sc, 0), glm::dvec3(sc, cc, 0), glm::dvec3(0, 0, 1));
+    const glm::dmat3 drz = fromRows(glm::dvec3(-sc, -cc, 0), glm::dvec3(cc, -sc, 0), glm::dvec3(0, 0, 0));
+    const glm::dmat3 ddrz = fromRows(glm::dvec3(-cc, sc, 0), glm::dvec3(-sc, -cc, 0), glm::dvec3(0, 0, 0));
+
+    rotation = rx * ry * rz;
+    first[0] = drx * ry * rz;
+    first[1] = rx * dry * rz;
+    first[2] = rx * ry * drz;
+    second[0][0] = ddrx * ry * rz;
+    second[0][1] = second[1][0] = drx * dry * rz;
+    second[0][2] = second[2][0] = drx * ry * drz;
+    second[1][1] = rx * ddry * rz;
+    second[1][2] = second[2][1] = rx * dry * drz;
+    second[2][2] = rx * ry * ddrz;
+  }
+};
+
+/// Constants of the NDT score function. See Magnusson (2009), equations 6.8 and 6.9.
+struct ScoreConstants
+{
+  double d1 = 0;
+  double d2 = 0;
+
+  ScoreConstants(double outlier_ratio, double resolution)
+  {
+    const double c1 = 10.0 * (1.0 - outlier_ratio);
+    const double c2 = outlier_ratio / (resolution * resolution * resolution);
+    const double d3 = -std::log(c2);
+    d1 = -std::log(c1 + c2) - d3;
+    d2 = -2.0 * std::log((-std::log(c1 * std::exp(-0.5) + c2) - d3) / d1);
+  }
+};
+
+/// Add @p other into @p score .
+void accumulate(NdtScore &score, const NdtScore &other)
+{
+  score.score += other.score;
+  for (size_t i = 0; i < score.gradient.size(); ++i)
+  {
+    score.gradient[i] += other.gradient[i];
+  }
+  for (size_t i = 0; i < score.hessian.size(); ++i)
+  {
+    score.hessian[i] += other.hessian[i];
+  }
+  score.match_count += other.match_count;
+}
+
+
+/// Solve the 6x6 linear system `a * x = b` by Gaussian elimination with partial pivoting.
+/// @return False if @p a is singular.
+bool solve6(std::array<double, 36> a, std::array<double, 6> b, std::array<double, 6> *x)
+{
+  const int n = 6;
+  for (int col = 0; col < n; ++col)
+  {
+    int pivot = col;
+    for (int row = col + 1; row < n; ++row)
+    {
+      if (std::abs(a[row * n + col]) > std::abs(a[pivot * n + col]))
+      {
+        pivot = row;
+      }
+    }
+    if (std::abs(a[pivot * n + col]) < 1e-12)  // NOLINT(readability-magic-numbers)
+    {
+      return false;
+    }
+    if (pivot != col)
+    {
+      for (int k = 0; k < n; ++k)
+      {
+        std::swap(a[col * n + k], a[pivot * n + k]);
+      }
+      std::swap(b[col], b[pivot]);
+    }
+    for (int row = col + 1; row < n; ++row)
+    {
+      const double factor = a[row * n + col] / a[col * n + col];
+      for (int k = col; k < n; ++k)
+      {
+        a[row * n + k] -= factor * a[col * n + k];
+      }
+      b[row] -= factor * b[col];
+    }
+  }
+
+  for (int row = n - 1; row >= 0; --row)
+  {
+    double sum = b[row];
+    for (int k = row + 1; k < n; ++k)
+    {
+      sum -= a[row * n + k] * (*x)[k];
+    }
+    (*x)[row] = sum / a[row * n + row];
+  }
+  return true;
+}
+}  // namespace
+
+
+struct NdtRegistrationDetail
+{
+  const NdtMap *ndt_map = nullptr;
+  NdtRegistrationParams params;
+  RegionDistributionMap regions;
+
+  inline const OccupancyMap &map() const { return ndt_map->map(); }
+
+  /// Build or refresh the distributions for the region at @p region_key .
+  void updateRegion(const glm::i16vec3 &region_key);
+  /// Ensure the distributions are current for the regions which @p points may match at @p pose .
+  void updateRegions(const glm::dvec3 *points, size_t point_count, const PoseDerivatives &derivatives,
+                     const glm::dvec3 &translation);
+  /// Find the cached distribution for @p key .
+  const NdtDistribution *distribution(const Key &key) const;
+  /// Evaluate @p points accumulating into @p score .
+  void evaluatePoints(const glm::dvec3 *points, size_t point_count, const PoseDerivatives &derivatives,
+                      const glm::dvec3 &translation, const ScoreConstants &constants, bool with_hessian,
+                      NdtScore &score) const;
+};
+
+
+void NdtRegistrationDetail::updateRegion(const glm::i16vec3 &region_key)
+{
+  const OccupancyMap &map = this->map();
+  const MapLayout &layout = map.layout();
+  const int occupancy_layer = layout.occupancyLayer();
+  const int mean_layer = layout.meanLayer();
+  const int covariance_layer = layout.covarianceLayer();
+  const MapChunk *chunk = map.region(region_key);
+
+  auto &entry = regions[region_key];
+  if (!chunk || occupancy_layer < 0 || mean_layer < 0 || covariance_layer < 0)
+  {
+    // Cache the absence of distributions.
+    entry.reset();
+    return;
+  }
+
+  const uint64_t stamp = std::max(chunk->layerTouchedStamp(unsigned(occupancy_layer)),
+                                  std::max(chunk->layerTouchedStamp(unsigned(mean_layer)),
+                                           chunk->layerTouchedStamp(unsigned(covariance_layer))));
+  if (entry && entry->stamp == stamp)
+  {
+    return;
+  }
+
+  if (!entry)
+  {
+    entry = std::make_unique<RegionDistributions>();
+  }
+  entry->stamp = stamp;
+  entry->distributions.clear();
+
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  entry->voxel_distribution.assign(size_t(region_dim.x) * size_t(region_dim.y) * size_t(region_dim.z), -1);
+  const unsigned min_sample_count =
+    (params.min_sample_count) ? params.min_sample_count : ndt_map->ndtSampleThreshold();
+  const float occupancy_threshold = map.occupancyThresholdValue();
+  const double resolution = map.resolution();
+  const VoxelOrder order = resolveVoxelOrder(voxelOrderFromFlags(map.flags()), region_dim);
+
+  VoxelBuffer<const VoxelBlock> occupancy_buffer(chunk->voxel_blocks[occupancy_layer]);
+  VoxelBuffer<const VoxelBlock> mean_buffer(chunk->voxel_blocks[mean_layer]);
+  VoxelBuffer<const VoxelBlock> covariance_buffer(chunk->voxel_blocks[covariance_layer]);
+
+  glm::ivec3 local_key;
+  for (local_key.z = 0; local_key.z < region_dim.z; ++local_key.z)
+  {
+    for (local_key.y = 0; local_key.y < region_dim.y; ++local_key.y)
+    {
+      for (local_key.x = 0; local_key.x < region_dim.x; ++local_key.x)
+      {
+        const unsigned voxel_index = voxelIndex(glm::u8vec3(local_key), region_dim, order);
+        float occupancy = unobservedOccupancyValue();
+        occupancy_buffer.readVoxel(voxel_index, &occupancy);
+        if (occupancy == unobservedOccupancyValue() || (params.occupied_only && occupancy < occupancy_threshold))
+        {
+          continue;
+        }
+
+        VoxelMean mean{};
+        mean_buffer.readVoxel(voxel_index, &mean);
+        if (mean.count < min_sample_count)
+        {
+          continue;
+        }
+
+        CovarianceVoxel covariance{};
+        covariance_buffer.readVoxel(voxel_index, &covariance);
+
+        // Regularise the covariance by clamping the eigenvalues, then invert.
+        glm::dmat3 eigenvectors;
+        glm::dvec3 eigenvalues;
+        covarianceEigenDecomposition(&covariance, &eigenvectors, &eigenvalues);
+        const double max_eigenvalue = std::max(eigenvalues.x, std::max(eigenvalues.y, eigenvalues.z));
+        if (!(max_eigenvalue > 0))
+        {
+          continue;
+        }
+        const double min_eigenvalue = max_eigenvalue * params.min_eigenvalue_ratio;
+        glm::dmat3 inverse_eigenvalues(0.0);
+        for (int i = 0; i < 3; ++i)
+        {
+          inverse_eigenvalues[i][i] = 1.0 / std::max(eigenvalues[i], min_eigenvalue);
+        }
+
+        NdtDistribution distribution;
+        const Key key(region_key, glm::u8vec3(local_key));
+        distribution.mean = position(mean, map.voxelCentreGlobal(key), resolution);
+        distribution.inverse_covariance = eigenvectors * inverse_eigenvalues * glm::transpose(eigenvectors);
+
+        entry->voxel_distribution[voxelIndex(glm::u8vec3(local_key), region_dim)] = int(entry->distributions.size());
+        entry->distributions.emplace_back(distribution);
+      }
+    }
+  }
+}
+
+
+void NdtRegistrationDetail::updateRegions(const glm::dvec3 *points, size_t point_count,
+                                          const PoseDerivatives &derivatives, const glm::dvec3 &translation)
+{
+  const OccupancyMap &map = this->map();
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> region_keys;
+  for (size_t i = 0; i < point_count; ++i)
+  {
+    const Key key = map.voxelKey(derivatives.rotation * points[i] + translation);
+    if (key.isNull())
+    {
+      continue;
+    }
+    region_keys.emplace(key.regionKey());
+    if (params.use_neighbours)
+    {
+      // Neighbours may lie in adjacent regions when the voxel is on a region face.
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        if (key.localKey()[axis] == 0 || key.localKey()[axis] == region_dim[axis] - 1)
+        {
+          glm::i16vec3 neighbour = key.regionKey();
+          neighbour[axis] = int16_t(neighbour[axis] + ((key.localKey()[axis] == 0) ? -1 : 1));
+          region_keys.emplace(neighbour);
+        }
+      }
+    }
+  }
+
+  for (const auto &region_key : region_keys)
+  {
+    updateRegion(region_key);
+  }
+}
+
+
+const NdtDistribution *NdtRegistrationDetail::distribution(const Key &key) const
+{
+  const auto iter = regions.find(key.regionKey());
+  if (iter == regions.end() || !iter->second)
+  {
+    return nullptr;
+  }
+  const RegionDistributions &region = *iter->second;
+  const int index = region.voxel_distribution[voxelIndex(key, glm::ivec3(map().regionVoxelDimensions()))];
+  return (index >= 0) ? &region.distributions[index] : nullptr;
+}
+
+
+void NdtRegistrationDetail::evaluatePoints(const glm::dvec3 *points, size_t point_count,
+                                           const PoseDerivatives &derivatives, const glm::dvec3 &translation,
+                                           const ScoreConstants &constants, bool with_hessian, NdtScore &score) const
+{
+  const OccupancyMap &map = this->map();
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  std::array<Key, 7> keys;  // NOLINT(readability-magic-numbers)
+  std::array<glm::dvec3, 6> jacobian;
+  std::array<glm::dvec3, 6> cov_jacobian;
+  std::array<double, 6> q_jacobian;
+
+  for (size_t p = 0; p < point_count; ++p)
+  {
+    const glm::dvec3 &point = points[p];
+    const glm::dvec3 transformed = derivatives.rotation * point + translation;
+    const Key key = map.voxelKey(transformed);
+    if (key.isNull())
+    {
+      continue;
+    }
+
+    size_t key_count = 0;
+    keys[key_count++] = key;
+    if (params.use_neighbours)
+    {
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        for (int dir = -1; dir <= 1; dir += 2)
+        {
+          Key neighbour = key;
+          OccupancyMap::stepKey(neighbour, axis, dir, region_dim);
+          keys[key_count++] = neighbour;
+        }
+      }
+    }
+
+    // Point Jacobian. Translation columns are the unit axes.
+    jacobian[0] = glm::dvec3(1, 0, 0);
+    jacobian[1] = glm::dvec3(0, 1, 0);
+    jacobian[2] = glm::dvec3(0, 0, 1);
+    for (int i = 0; i < 3; ++i)
+    {
+      jacobian[3 + i] = derivatives.first[i] * point;
+    }
+
+    for (size_t k = 0; k < key_count; ++k)
+    {
+      const NdtDistribution *distribution = this->distribution(keys[k]);
+      if (!distribution)
+      {
+        continue;
+      }
+
+      const glm::dvec3 diff = transformed - distribution->mean;
+      const glm::dmat3 &inv_cov = distribution->inverse_covariance;
+      const glm::dvec3 q = inv_cov * diff;
+      const double exponent = std::exp(-0.5 * constants.d2 * glm::dot(diff, q));
+      // Reject numerically invalid contributions.
+      const double check = constants.d2 * exponent;
+      if (!(check >= 0 && check <= 1))
+      {
+        continue;
+      }
+
+      score.score += -constants.d1 * exponent;
+      ++score.match_count;
+      const double factor = constants.d1 * constants.d2 * exponent;
+      for (int i = 0; i < 6; ++i)
+      {
+        cov_jacobian[i] = inv_cov * jacobian[i];
+        q_jacobian[i] = glm::dot(q, jacobian[i]);
+        score.gradient[i] += factor * q_jacobian[i];
+      }
+
+      if (with_hessian)
+      {
+        for (int i = 0; i < 6; ++i)
+        {
+          for (int j = 0; j <= i; ++j)
+          {
+            double term = -constants.d2 * q_jacobian[i] * q_jacobian[j] + glm::dot(jacobian[j], cov_jacobian[i]);
+            if (i >= 3 && j >= 3)
+            {
+              term += glm::dot(q, derivatives.second[i - 3][j - 3] * point);
+            }
+            score.hessian[i * 6 + j] += factor * term;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+NdtRegistration::NdtRegistration(const NdtMap &ndt_map, const NdtRegistrationParams &params)
+  : imp_(std::make_unique<NdtRegistrationDetail>())
+{
+  imp_->ndt_map = &ndt_map;
+  imp_->params = params;
+}
+
+
+NdtRegistration::~NdtRegistration() = default;
+
+
+const NdtRegistrationParams &NdtRegistration::params() const
+{
+  return imp_->params;
+}
+
+
+void NdtRegistration::setParams(const NdtRegistrationParams &params)
+{
+  imp_->params = params;
+  clearCache();
+}
+
+
+glm::dmat4 NdtRegistration::poseToTransform(const NdtPose &pose)
+{
+  const PoseDerivatives derivatives(pose);
+  glm::dmat4 transform(derivatives.rotation);
+  transform[3] = glm::dvec4(pose[0], pose[1], pose[2], 1.0);
+  return transform;
+}
+
+
+NdtPose NdtRegistration::transformToPose(const glm::dmat4 &transform)
+{
+  // Elements are accessed as transform[column][row]. See PoseDerivatives for the rotation composition.
+  NdtPose pose;
+  pose[0] = transform[3][0];
+  pose[1] = transform[3][1];
+  pose[2] = transform[3][2];
+  pose[3] = std::atan2(-transform[2][1], transform[2][2]);
+  pose[4] = std::asin(std::max(-1.0, std::min(transform[2][0], 1.0)));
+  pose[5] = std::atan2(-transform[1][0], transform[0][0]);
+  return pose;
+}
+
+
+NdtScore NdtRegistration::evaluate(const glm::dvec3 *points, size_t point_count, const NdtPose &pose,
+                                   bool with_hessian)
+{
+  NdtRegistrationDetail &imp = *imp_;
+  const PoseDerivatives derivatives(pose);
+  const glm::dvec3 translation(pose[0], pose[1], pose[2]);
+  const ScoreConstants constants(imp.params.outlier_ratio, imp.map().resolution());
+
+  imp.updateRegions(points, point_count, derivatives, translation);
+
+  const size_t block_count = (point_count + kPointBlockSize - 1) / kPointBlockSize;
+  std::vector<NdtScore> block_scores(block_count);
+  const auto evaluate_blocks = [&](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; ++block)
+    {
+      const size_t first = block * kPointBlockSize;
+      imp.evaluatePoints(points + first, std::min(kPointBlockSize, point_count - first), derivatives, translation,
+                         constants, with_hessian, block_scores[block]);
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (imp.params.use_threads && block_count > 1)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, block_count),
+                        [&evaluate_blocks](const tbb::blocked_range<size_t> &range) {
+                          evaluate_blocks(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    evaluate_blocks(0, block_count);
+  }
+
+  NdtScore score;
+  for (const NdtScore &block_score : block_scores)
+  {
+    accumulate(score, block_score);
+  }
+
+  if (with_hessian)
+  {
+    // Only the lower triangle was accumulated.
+    for (int i = 0; i < 6; ++i)
+    {
+      for (int j = i + 1; j < 6; ++j)
+      {
+        score.hessian[i * 6 + j] = score.hessian[j * 6 + i];
+      }
+    }
+  }
+
+  return score;
+}
+
+
+NdtAlignResult NdtRegistration::align(const glm::dvec3 *points, size_t point_count,
+                                      const glm::dmat4 &initial_transform)
+{
+  const NdtRegistrationParams &params = imp_->params;
+  NdtAlignResult result;
+  result.pose = transformToPose(initial_transform);
+  result.score = evaluate(points, point_count, result.pose, true);
+
+  for (result.iterations = 0; result.iterations < params.max_iterations && !result.converged; ++result.iterations)
+  {
+    // Newton step: solve H * step = -g.
+    std::array<double, 6> step{};
+    std::array<double, 6> negative_gradient{};
+    for (int i = 0; i < 6; ++i)
+    {
+      negative_gradient[i] = -result.score.gradient[i];
+    }
+
+    double ascent = 0;
+    if (solve6(result.score.hessian, negative_gradient, &step))
+    {
+      for (int i = 0; i < 6; ++i)
+      {
+        ascent += step[i] * result.score.gradient[i];
+      }
+    }
+
+    if (!(ascent > 0))
+    {
+      // The Hessian is not negative definite here. Fall back to gradient ascent.
+      step = result.score.gradient;
+    }
+
+    // Limit the step size.
+    double max_component = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+      max_component = std::max(max_component, std::abs(step[i]));
+    }
+    if (max_component <= 0)
+    {
+      result.converged = true;
+      break;
+    }
+    if (max_component > params.max_step)
+    {
+      for (double &value : step)
+      {
+        value *= params.max_step / max_component;
+      }
+      max_component = params.max_step;
+    }
+
+    // Backtracking line search for an improved score.
+    bool improved = false;
+    double scale = 1.0;
+    const int max_backtracks = 10;
+    for (int backtrack = 0; backtrack < max_backtracks && !improved; ++backtrack, scale *= 0.5)
+    {
+      NdtPose candidate = result.pose;
+      for (int i = 0; i < 6; ++i)
+      {
+        candidate[i] += scale * step[i];
+      }
+      const NdtScore candidate_score = evaluate(points, point_count, candidate, false);
+      if (candidate_score.score > result.score.score)
+      {
+        improved = true;
+        result.pose = candidate;
+      }
+    }
+
+    const double step_length = 2.0 * scale * max_component;  // Undo the last halving.
+    if (!improved || step_length < params.transformation_epsilon)
+    {
+      result.converged = true;
+    }
+
+    if (improved)
+    {
+      result.score = evaluate(points, point_count, result.pose, true);
+    }
+  }
+
+  result.transform = poseToTransform(result.pose);
+  return result;
+}
+
+
+void NdtRegistration::clearCache()
+{
+  imp_->regions.clear();
+}
+
+
+size_t NdtRegistration::cachedRegionCount() const
+{
+  size_t count = 0;
+  for (const auto &region : imp_->regions)
+  {
+    count += !!region.second;
+  }
+  return count;
+}
+}  // namespace ohm
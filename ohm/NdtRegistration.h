@@ -0,0 +1,151 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_NDTREGISTRATION_H
+#define OHM_NDTREGISTRATION_H
+
+#include "OhmConfig.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+namespace ohm
+{
+class NdtMap;
+struct NdtRegistrationDetail;
+
+/// A 6 degree of freedom pose for @c NdtRegistration : `(x, y, z, roll, pitch, yaw)` . The rotation is
+/// `Rx(roll) * Ry(pitch) * Rz(yaw)` and the translation is applied after the rotation.
+using NdtPose = std::array<double, 6>;
+
+/// Parameters for @c NdtRegistration .
+struct ohm_API NdtRegistrationParams
+{
+  /// Expected ratio of scan points which do not match the map. Shapes the NDT score function.
+  double outlier_ratio = 0.55;  // NOLINT(readability-magic-numbers)
+  /// Maximum change in any pose parameter per iteration of @c NdtRegistration::align() (metres or radians).
+  double max_step = 0.1;  // NOLINT(readability-magic-numbers)
+  /// Alignment terminates once the pose changes by less than this in an iteration.
+  double transformation_epsilon = 1e-4;  // NOLINT(readability-magic-numbers)
+  /// Maximum number of Newton iterations for @c NdtRegistration::align() .
+  unsigned max_iterations = 35;  // NOLINT(readability-magic-numbers)
+  /// Minimum number of samples a voxel requires to contribute a distribution. Zero to use
+  /// @c NdtMap::ndtSampleThreshold() .
+  unsigned min_sample_count = 0;
+  /// Covariance eigenvalues are clamped to at least this ratio of the largest eigenvalue to regularise planar and
+  /// linear distributions before inversion.
+  double min_eigenvalue_ratio = 0.01;  // NOLINT(readability-magic-numbers)
+  /// Only use distributions from occupied voxels?
+  bool occupied_only = true;
+  /// Match each point against the distributions of its voxel and the six face neighbours rather than its voxel only.
+  bool use_neighbours = true;
+  /// Evaluate points using multiple threads when available.
+  bool use_threads = true;
+};
+
+/// The NDT score of a scan and its derivatives with respect to the @c NdtPose .
+struct ohm_API NdtScore
+{
+  /// The score to maximise. Larger values indicate a better match.
+  double score = 0;
+  /// Gradient of the @c score .
+  std::array<double, 6> gradient{};  // NOLINT(readability-magic-numbers)
+  /// Hessian of the @c score , row major. Left at zero when not requested.
+  std::array<double, 36> hessian{};  // NOLINT(readability-magic-numbers)
+  /// Number of point to distribution pairs contributing to the score.
+  size_t match_count = 0;
+};
+
+/// Results of @c NdtRegistration::align() .
+struct ohm_API NdtAlignResult
+{
+  /// The final transform from scan to map coordinates.
+  glm::dmat4 transform{ 1.0 };
+  /// The final pose.
+  NdtPose pose{};
+  /// The score at the final pose. The Hessian is for the last Newton step.
+  NdtScore score;
+  /// Number of iterations performed.
+  unsigned iterations = 0;
+  /// True if the alignment converged within the @c NdtRegistrationParams::max_iterations .
+  bool converged = false;
+};
+
+/// Aligns scans to an @c NdtMap using Normal Distributions Transform (NDT) registration, directly using the map's
+/// @c VoxelMean and @c CovarianceVoxel layers.
+///
+/// Each scan point is scored against the normal distributions of the voxel which contains it after transformation and,
+/// optionally, the neighbouring voxels. The score, gradient and Hessian follow the formulation of Magnusson (2009)
+/// and are evaluated in blocks of points, in parallel when threads are available. @c align() maximises the score using
+/// Newton's method with a backtracking line search.
+///
+/// Distributions are cached per region with the regularised inverse covariance. A region is rebuilt when its
+/// occupancy, mean or covariance layer has been touched since it was cached, so the registration tracks a map which is
+/// updated between scans. The map must not be modified during an @c evaluate() or @c align() call. A GPU map must be
+/// synchronised to the CPU before registration - see @c GpuMap::syncVoxels() .
+///
+/// > Magnusson, M. (2009). The Three-Dimensional Normal-Distributions Transform: an Efficient Representation for
+/// > Registration, Surface Analysis, and Loop Detection. PhD thesis, Orebro University.
+class ohm_API NdtRegistration
+{
+public:
+  /// Constructor.
+  /// @param ndt_map The map to register against. Must outlive this object.
+  /// @param params Registration parameters.
+  explicit NdtRegistration(const NdtMap &ndt_map, const NdtRegistrationParams &params = NdtRegistrationParams());
+  /// Destructor.
+  ~NdtRegistration();
+
+  NdtRegistration(const NdtRegistration &) = delete;
+  NdtRegistration &operator=(const NdtRegistration &) = delete;
+
+  /// Access the registration parameters.
+  /// @return The current parameters.
+  const NdtRegistrationParams &params() const;
+  /// Set the registration parameters. Clears the distribution cache.
+  /// @param params The new parameters.
+  void setParams(const NdtRegistrationParams &params);
+
+  /// Convert a pose to a transform.
+  /// @param pose The pose to convert.
+  /// @return The equivalent transform.
+  static glm::dmat4 poseToTransform(const NdtPose &pose);
+  /// Convert a rigid transform to a pose.
+  /// @param transform The transform to convert. Must not include scaling.
+  /// @return The equivalent pose.
+  static NdtPose transformToPose(const glm::dmat4 &transform);
+
+  /// Evaluate the NDT score of @p points at @p pose .
+  /// @param points The scan points in the scan frame.
+  /// @param point_count The number of @p points .
+  /// @param pose The pose transforming @p points into the map frame.
+  /// @param with_hessian Calculate the @c NdtScore::hessian ?
+  /// @return The score and derivatives.
+  NdtScore evaluate(const glm::dvec3 *points, size_t point_count, const NdtPose &pose, bool with_hessian = true);
+
+  /// Align @p points to the map, starting from @p initial_transform .
+  /// @param points The scan points in the scan frame.
+  /// @param point_count The number of @p points .
+  /// @param initial_transform Initial estimate of the transform from the scan frame to the map frame.
+  /// @return The alignment results.
+  NdtAlignResult align(const glm::dvec3 *points, size_t point_count, const glm::dmat4 &initial_transform);
+
+  /// Release all cached distributions.
+  void clearCache();
+
+  /// Query the number of regions with cached distributions.
+  /// @return The cached region count.
+  size_t cachedRegionCount() const;
+
+private:
+  std::unique_ptr<NdtRegistrationDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_NDTREGISTRATION_H
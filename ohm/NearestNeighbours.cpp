@@ -14,6 +14,7 @@
 #include "Key.h"
 #include "MapChunk.h"
 #include "OccupancyMap.h"
+#include "OccupancySummary.h"
 #include "QueryFlag.h"
 #include "VoxelBlock.h"
 #include "VoxelBuffer.h"
@@ -43,6 +44,9 @@ unsigned regionNearestNeighboursCpu(OccupancyMap &map, NearestNeighboursDetail &
   Key voxel_key(nullptr);
   const MapChunk *chunk = nullptr;
   const uint8_t *occupancy_mem = nullptr;
+  size_t occupancy_stride = sizeof(float);
+  const RegionOccupancySummary *summary = nullptr;
+  const bool unknown_as_occupied = (query.query_flags & ohm::kQfUnknownAsOccupied) != 0;
   float range_squared = 0;
   unsigned added = 0;
   VoxelBuffer<VoxelBlock> voxel_buffer;
@@ -70,10 +74,18 @@ unsigned regionNearestNeighboursCpu(OccupancyMap &map, NearestNeighboursDetail &
   else
   {
     chunk = chunk_search->second;
+    // Skip the region entirely if the summary shows it has nothing to add.
+    summary = updateOccupancySummary(*chunk_search->second);
+    if (summary &&
+        !summary->regionBrick().mayContainOccupied(map_data.occupancy_threshold_value, unknown_as_occupied))
+    {
+      return 0;
+    }
     // FIXME: (KS) This is a bit of a mix of legacy direct voxel access and newer VoxelBlock access. Makes things a
     // bit unclear.
     voxel_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[chunk->layout().occupancyLayer()]);
     occupancy_mem = voxel_buffer.voxelMemory();
+    occupancy_stride = (voxel_buffer.voxelStride()) ? voxel_buffer.voxelStride() : sizeof(float);
     // Setup the voxel test function to check the occupancy threshold and behaviour flags.
     voxel_occupied_func = [&query](const float voxel, const OccupancyMapDetail &map_data) -> bool {
       if (voxel == unobservedOccupancyValue())
@@ -92,6 +104,7 @@ unsigned regionNearestNeighboursCpu(OccupancyMap &map, NearestNeighboursDetail &
   // TES_BOX_W(g_tes, TES_COLOUR(LightSeaGreen), 0u,
   //           glm::value_ptr(region_centre), glm::value_ptr(map.regionSpatialResolution()));
 
+  const VoxelOrder voxel_order = map.layerVoxelOrder(map_data.layout.occupancyLayer());
   float occupancy;
   for (int z = 0; z < map_data.region_voxel_dimensions.z; ++z)
   {
@@ -99,7 +112,22 @@ unsigned regionNearestNeighboursCpu(OccupancyMap &map, NearestNeighboursDetail &
     {
       for (int x = 0; x < map_data.region_voxel_dimensions.x; ++x)
       {
-        memcpy(&occupancy, occupancy_mem, sizeof(float));
+        // Skip voxels in bricks which cannot be occupied.
+        const int empty_run =
+          (summary) ?
+            summary->emptyRunLength(glm::ivec3(x, y, z), map_data.occupancy_threshold_value, unknown_as_occupied) :
+            0;
+        if (empty_run > 0)
+        {
+          x += empty_run - 1;
+          continue;
+        }
+        // Leave the pointer as is (pointing to invalid_occupancy_value) if the chunk is invalid.
+        const size_t voxel_offset =
+          (chunk != nullptr) ?
+            occupancy_stride * voxelIndex(glm::u8vec3(x, y, z), map_data.region_voxel_dimensions, voxel_order) :
+            0;
+        memcpy(&occupancy, occupancy_mem + voxel_offset, sizeof(float));
         if (voxel_occupied_func(occupancy, map_data))
         {
           // Occupied voxel, or invalid voxel to be treated as occupied.
@@ -145,9 +173,6 @@ unsigned regionNearestNeighboursCpu(OccupancyMap &map, NearestNeighboursDetail &
           }
 #endif  // TES_ENABLE
         }
-
-        // Next voxel. Leave pointer as is (pointing to invalid_occupancy_value) if the chunk is invalid.
-        occupancy_mem += (chunk != nullptr) ? sizeof(occupancy) : 0;
       }
     }
   }
@@ -203,6 +228,8 @@ NearestNeighbours::NearestNeighbours(OccupancyMap &map, const glm::dvec3 &near_p
 
 NearestNeighbours::~NearestNeighbours()
 {
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
   NearestNeighboursDetail *d = imp();
   delete d;
   imp_ = nullptr;
@@ -286,7 +313,14 @@ bool NearestNeighbours::onExecute()
 
 bool NearestNeighbours::onExecuteAsync()
 {
-  return false;
+  NearestNeighboursDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return executeCpuAsync([this]() { return NearestNeighbours::onExecute(); });
 }
 
 
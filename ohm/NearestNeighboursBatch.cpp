@@ -0,0 +1,452 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "NearestNeighboursBatch.h"
+
+#include "private/NearestNeighboursBatchDetail.h"
+#include "private/QueryRegionCache.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapFlag.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "OccupancySummary.h"
+#include "TaskArena.h"
+#include "VoxelBlock.h"
+#include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrderCompute.h"
+
+#include <glm/glm.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace ohm
+{
+namespace
+{
+/// Number of sorted query points per independently evaluated block.
+constexpr size_t kPointsPerBlock = 256u;
+
+/// Results for a block of sorted query points.
+struct BatchBlock
+{
+  std::vector<Key> keys;
+  std::vector<double> ranges;
+  /// Offset into @c keys for each query point in the block.
+  std::vector<size_t> offsets;
+  /// Number of @c keys for each query point in the block.
+  std::vector<size_t> counts;
+};
+
+
+/// Search around a single @p near_point , appending results to @p block .
+void nearestNeighboursPoint(OccupancyMap &map, QueryRegionCache &cache, const glm::dvec3 &near_point,
+                            float search_radius, unsigned query_flags, BatchBlock &block)
+{
+  const bool unknown_as_occupied = (query_flags & kQfUnknownAsOccupied) != 0;
+  const float occupancy_threshold = map.occupancyThresholdValue();
+  const glm::ivec3 dim(map.regionVoxelDimensions());
+  const VoxelOrder voxel_order = map.layerVoxelOrder(map.layout().occupancyLayer());
+  const glm::vec3 query_origin(near_point - map.origin());
+  const float radius_squared = search_radius * search_radius;
+
+  const Key min_key = map.voxelKey(near_point - glm::dvec3(search_radius));
+  const Key max_key = map.voxelKey(near_point + glm::dvec3(search_radius));
+
+  const size_t first_result = block.keys.size();
+  size_t closest_index = first_result;
+  float closest_range_squared = std::numeric_limits<float>::max();
+
+  for (int rz = min_key.regionKey().z; rz <= max_key.regionKey().z; ++rz)
+  {
+    for (int ry = min_key.regionKey().y; ry <= max_key.regionKey().y; ++ry)
+    {
+      for (int rx = min_key.regionKey().x; rx <= max_key.regionKey().x; ++rx)
+      {
+        const glm::i16vec3 region_key(rx, ry, rz);
+        const QueryCachedRegion &region = cache.region(region_key);
+        if (!region.chunk && !unknown_as_occupied)
+        {
+          // Unknown region and unknown space is considered free.
+          continue;
+        }
+
+        if (region.summary &&
+            !region.summary->regionBrick().mayContainOccupied(occupancy_threshold, unknown_as_occupied))
+        {
+          continue;
+        }
+
+        // Restrict the search to the voxels within the search bounds.
+        glm::ivec3 local_min(0);
+        glm::ivec3 local_max = dim - glm::ivec3(1);
+        for (int a = 0; a < 3; ++a)
+        {
+          local_min[a] = (region_key[a] == min_key.regionKey()[a]) ? int(min_key.localKey()[a]) : 0;
+          local_max[a] = (region_key[a] == max_key.regionKey()[a]) ? int(max_key.localKey()[a]) : dim[a] - 1;
+        }
+
+        const uint8_t *occupancy_mem = (region.chunk) ? region.buffer.voxelMemory() : nullptr;
+        for (int z = local_min.z; z <= local_max.z; ++z)
+        {
+          for (int y = local_min.y; y <= local_max.y; ++y)
+          {
+            for (int x = local_min.x; x <= local_max.x; ++x)
+            {
+              // Skip voxels in bricks which cannot be occupied.
+              const int empty_run =
+                (region.summary) ?
+                  region.summary->emptyRunLength(glm::ivec3(x, y, z), occupancy_threshold, unknown_as_occupied) :
+                  0;
+              if (empty_run > 0)
+              {
+                x += empty_run - 1;
+                continue;
+              }
+
+              float occupancy = unobservedOccupancyValue();
+              if (occupancy_mem)
+              {
+                const unsigned voxel_index = voxelIndex(glm::u8vec3(x, y, z), dim, voxel_order);
+                memcpy(&occupancy, occupancy_mem + voxel_index * sizeof(occupancy), sizeof(occupancy));
+              }
+
+              const bool occupied = (occupancy == unobservedOccupancyValue()) ? unknown_as_occupied :
+                                                                                occupancy >= occupancy_threshold;
+              if (!occupied)
+              {
+                continue;
+              }
+
+              const Key voxel_key(region_key, x, y, z);
+              const glm::vec3 voxel_vector = glm::vec3(map.voxelCentreLocal(voxel_key)) - query_origin;
+              const float range_squared = glm::dot(voxel_vector, voxel_vector);
+              if (range_squared <= radius_squared)
+              {
+                if (range_squared < closest_range_squared)
+                {
+                  closest_index = block.keys.size();
+                  closest_range_squared = range_squared;
+                }
+                block.keys.emplace_back(voxel_key);
+                block.ranges.emplace_back(std::sqrt(range_squared));
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if ((query_flags & kQfNearestResult) && block.keys.size() > first_result)
+  {
+    block.keys[first_result] = block.keys[closest_index];
+    block.ranges[first_result] = block.ranges[closest_index];
+    block.keys.resize(first_result + 1);
+    block.ranges.resize(first_result + 1);
+  }
+
+  block.offsets.emplace_back(first_result);
+  block.counts.emplace_back(block.keys.size() - first_result);
+}
+
+
+/// Sort the query points in @p d by region, then by Morton order of the point's voxel within the region.
+/// @return Indices into @c NearestNeighboursBatchDetail::near_points in evaluation order.
+std::vector<size_t> sortNearPoints(const NearestNeighboursBatchDetail &d)
+{
+  struct SortKey
+  {
+    glm::i16vec3 region_key;
+    unsigned morton;
+  };
+
+  std::vector<Key> keys(d.near_points.size());
+  d.map->voxelKeys(d.near_points.data(), d.near_points.size(), keys.data());
+  std::vector<SortKey> sort_keys(d.near_points.size());
+  for (size_t i = 0; i < d.near_points.size(); ++i)
+  {
+    const Key &key = keys[i];
+    sort_keys[i].region_key = key.regionKey();
+    sort_keys[i].morton = mortonSpreadBits3(key.localKey().x) | (mortonSpreadBits3(key.localKey().y) << 1u) |
+                          (mortonSpreadBits3(key.localKey().z) << 2u);
+  }
+
+  std::vector<size_t> order(d.near_points.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::sort(order.begin(), order.end(), [&sort_keys](size_t a, size_t b) {
+    const SortKey &ka = sort_keys[a];
+    const SortKey &kb = sort_keys[b];
+    if (ka.region_key.z != kb.region_key.z)
+    {
+      return ka.region_key.z < kb.region_key.z;
+    }
+    if (ka.region_key.y != kb.region_key.y)
+    {
+      return ka.region_key.y < kb.region_key.y;
+    }
+    if (ka.region_key.x != kb.region_key.x)
+    {
+      return ka.region_key.x < kb.region_key.x;
+    }
+    return ka.morton < kb.morton;
+  });
+
+  return order;
+}
+
+
+/// Bring the occupancy summaries up to date for the regions searched by the sorted query points. This must be done
+/// before the threaded evaluation as @c updateOccupancySummary() is not thread safe.
+void updateBatchSummaries(NearestNeighboursBatchDetail &d, const std::vector<size_t> &order)
+{
+  OccupancyMap &map = *d.map;
+  if ((map.flags() & MapFlag::kOccupancySummary) == MapFlag::kNone)
+  {
+    return;
+  }
+
+  // Points are sorted by region, so update once per query point region using padded region bounds.
+  const glm::dvec3 padding = 0.5 * map.regionSpatialResolution() + glm::dvec3(d.search_radius);
+  bool have_region = false;
+  glm::i16vec3 last_region(0);
+  for (const size_t index : order)
+  {
+    const glm::i16vec3 region_key = map.regionKey(d.near_points[index]);
+    if (!have_region || region_key != last_region)
+    {
+      const glm::dvec3 region_centre = map.regionCentreGlobal(region_key);
+      updateOccupancySummaries(map, region_centre - padding, region_centre + padding);
+      last_region = region_key;
+      have_region = true;
+    }
+  }
+}
+
+
+bool nearestNeighboursBatchCpu(NearestNeighboursBatchDetail &d, bool use_threads)
+{
+  OccupancyMap &map = *d.map;
+  const int occupancy_layer = map.layout().occupancyLayer();
+  if (occupancy_layer < 0)
+  {
+    return false;
+  }
+
+  const std::vector<size_t> order = sortNearPoints(d);
+  updateBatchSummaries(d, order);
+
+  const size_t point_count = order.size();
+  const size_t block_count = (point_count + kPointsPerBlock - 1) / kPointsPerBlock;
+  std::vector<BatchBlock> blocks(block_count);
+
+  const auto evaluate_blocks = [&d, &map, &order, &blocks, occupancy_layer, point_count](size_t begin, size_t end) {
+    // Retain regions for the whole range as consecutive blocks continue the sorted order.
+    QueryRegionCache cache(map, occupancy_layer);
+    for (size_t b = begin; b < end; ++b)
+    {
+      const size_t first_point = b * kPointsPerBlock;
+      const size_t block_points = std::min(kPointsPerBlock, point_count - first_point);
+      BatchBlock &block = blocks[b];
+      block.offsets.reserve(block_points);
+      block.counts.reserve(block_points);
+      for (size_t i = first_point; i < first_point + block_points; ++i)
+      {
+        nearestNeighboursPoint(map, cache, d.near_points[order[i]], d.search_radius, d.query_flags, block);
+      }
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, block_count),
+                        [&evaluate_blocks](const tbb::blocked_range<size_t> &range) {
+                          evaluate_blocks(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    evaluate_blocks(0, block_count);
+  }
+
+  // Lay out the results in the original query point order.
+  d.result_indices.resize(point_count);
+  d.result_counts.resize(point_count);
+  for (size_t b = 0; b < block_count; ++b)
+  {
+    const BatchBlock &block = blocks[b];
+    for (size_t i = 0; i < block.counts.size(); ++i)
+    {
+      d.result_counts[order[b * kPointsPerBlock + i]] = block.counts[i];
+    }
+  }
+
+  size_t result_index = d.intersected_voxels.size();
+  for (size_t i = 0; i < point_count; ++i)
+  {
+    d.result_indices[i] = result_index;
+    result_index += d.result_counts[i];
+  }
+  d.intersected_voxels.resize(result_index);
+  d.ranges.resize(result_index);
+
+  for (size_t b = 0; b < block_count; ++b)
+  {
+    const BatchBlock &block = blocks[b];
+    for (size_t i = 0; i < block.counts.size(); ++i)
+    {
+      const size_t dst = d.result_indices[order[b * kPointsPerBlock + i]];
+      std::copy_n(block.keys.begin() + block.offsets[i], block.counts[i], d.intersected_voxels.begin() + dst);
+      std::copy_n(block.ranges.begin() + block.offsets[i], block.counts[i], d.ranges.begin() + dst);
+    }
+  }
+
+  d.number_of_results = point_count;
+
+  return true;
+}
+}  // namespace
+
+
+NearestNeighboursBatch::NearestNeighboursBatch(NearestNeighboursBatchDetail *detail)
+  : Query(detail)
+{}
+
+
+NearestNeighboursBatch::NearestNeighboursBatch(OccupancyMap &map, float search_radius, unsigned query_flags)
+  : NearestNeighboursBatch(query_flags)
+{
+  setMap(&map);
+  setSearchRadius(search_radius);
+}
+
+
+NearestNeighboursBatch::NearestNeighboursBatch(unsigned query_flags)
+  : NearestNeighboursBatch(new NearestNeighboursBatchDetail)
+{
+  setQueryFlags(query_flags);
+}
+
+
+NearestNeighboursBatch::~NearestNeighboursBatch()
+{
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
+  NearestNeighboursBatchDetail *d = imp();
+  delete d;
+  imp_ = nullptr;
+}
+
+
+void NearestNeighboursBatch::setNearPoints(const glm::dvec3 *points, size_t point_count)
+{
+  NearestNeighboursBatchDetail *d = imp();
+  d->near_points.assign(points, points + point_count);
+}
+
+
+const glm::dvec3 *NearestNeighboursBatch::nearPoints() const
+{
+  const NearestNeighboursBatchDetail *d = imp();
+  return d->near_points.data();
+}
+
+
+size_t NearestNeighboursBatch::nearPointCount() const
+{
+  const NearestNeighboursBatchDetail *d = imp();
+  return d->near_points.size();
+}
+
+
+float NearestNeighboursBatch::searchRadius() const
+{
+  const NearestNeighboursBatchDetail *d = imp();
+  return d->search_radius;
+}
+
+
+void NearestNeighboursBatch::setSearchRadius(float range)
+{
+  NearestNeighboursBatchDetail *d = imp();
+  d->search_radius = range;
+}
+
+
+const size_t *NearestNeighboursBatch::resultIndices() const
+{
+  const NearestNeighboursBatchDetail *d = imp();
+  return d->result_indices.data();
+}
+
+
+const size_t *NearestNeighboursBatch::resultCounts() const
+{
+  const NearestNeighboursBatchDetail *d = imp();
+  return d->result_counts.data();
+}
+
+
+bool NearestNeighboursBatch::onExecute()
+{
+  NearestNeighboursBatchDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return nearestNeighboursBatchCpu(*d, useThreads());
+}
+
+
+bool NearestNeighboursBatch::onExecuteAsync()
+{
+  NearestNeighboursBatchDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return executeCpuAsync([this]() { return NearestNeighboursBatch::onExecute(); });
+}
+
+
+void NearestNeighboursBatch::onReset(bool /*hard_reset*/)
+{
+  NearestNeighboursBatchDetail *d = imp();
+  d->result_indices.clear();
+  d->result_counts.clear();
+}
+
+
+NearestNeighboursBatchDetail *NearestNeighboursBatch::imp()
+{
+  return static_cast<NearestNeighboursBatchDetail *>(imp_);
+}
+
+
+const NearestNeighboursBatchDetail *NearestNeighboursBatch::imp() const
+{
+  return static_cast<const NearestNeighboursBatchDetail *>(imp_);
+}
+}  // namespace ohm
@@ -0,0 +1,107 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_NEARESTNEIGHBOURSBATCH_H
+#define OHM_NEARESTNEIGHBOURSBATCH_H
+
+#include "OhmConfig.h"
+
+#include "Query.h"
+#include "QueryFlag.h"
+
+#include <glm/fwd.hpp>
+
+namespace ohm
+{
+struct NearestNeighboursBatchDetail;
+
+/// A batched form of @c NearestNeighbours which searches around many query points in one execution.
+///
+/// Each query point reports the obstructed voxels whose centres lie within @c searchRadius() of the point, matching
+/// the @c NearestNeighbours results for that point (including @c kQfNearestResult and @c kQfUnknownAsOccupied
+/// behaviour), although the order of voxels within each point's results may differ.
+///
+/// The batch is evaluated in an order sorted by region, then by Morton order of the query point voxel within the
+/// region. Sorted points are split into fixed size blocks which are evaluated in parallel when built with
+/// @c OHM_FEATURE_THREADS and @c useThreads() is set. Each block retains the @c VoxelBuffer of recently visited
+/// regions, so nearby query points do not repeat the region lookup or buffer retention. Only the voxels within the
+/// bounds of each search sphere are visited.
+///
+/// The @c numberOfResults() matches the number of query points. For each point, there is an entry in
+/// @c resultIndices() and @c resultCounts() in the same order as the points given to @c setNearPoints(). The indices
+/// give the offsets into @c intersectedVoxels() and @c ranges() where the results for that point begin, while the
+/// counts give the number of voxels for that point.
+class ohm_API NearestNeighboursBatch : public Query
+{
+protected:
+  /// Constructor used for inherited objects. This supports deriving @p NearestNeighboursBatchDetail into
+  /// more specialised forms.
+  /// @param detail pimple style data structure. When null, a @c NearestNeighboursBatchDetail is allocated by
+  /// this method.
+  explicit NearestNeighboursBatch(NearestNeighboursBatchDetail *detail);
+
+public:
+  /// Construct a new query using the given parameters.
+  /// @param map The map to perform the query on.
+  /// @param search_radius Defines the search radius around each query point.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag .
+  NearestNeighboursBatch(OccupancyMap &map, float search_radius, unsigned query_flags = 0u);
+
+  /// Construct a new query using the given parameters.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag .
+  explicit NearestNeighboursBatch(unsigned query_flags = 0u);
+
+  /// Destructor.
+  ~NearestNeighboursBatch() override;
+
+  /// Set the global coordinates of the points to search around.
+  /// @param points The query points.
+  /// @param point_count Number of elements in @p points .
+  void setNearPoints(const glm::dvec3 *points, size_t point_count);
+
+  /// Get the array of query points set in the last call to @c setNearPoints().
+  /// @return The query points. The number of elements is @c nearPointCount().
+  const glm::dvec3 *nearPoints() const;
+
+  /// Return the number of elements in @c nearPoints().
+  /// @return The number of query points.
+  size_t nearPointCount() const;
+
+  /// Get the search radius around each query point.
+  /// @return The search radius.
+  float searchRadius() const;
+  /// Set the search radius around each query point.
+  /// @param range The new search radius.
+  void setSearchRadius(float range);
+
+  /// Get the array of result index offsets into @c intersectedVoxels() and @c ranges() for each query point.
+  ///
+  /// Only valid once execution completes.
+  ///
+  /// @return Index offsets for each query point. The number of elements is @c numberOfResults().
+  const size_t *resultIndices() const;
+
+  /// Get the array of result voxel counts for each query point.
+  ///
+  /// Only valid once execution completes.
+  ///
+  /// @return Number of voxels reported for each query point. The number of elements is @c numberOfResults().
+  const size_t *resultCounts() const;
+
+protected:
+  bool onExecute() override;
+  bool onExecuteAsync() override;
+  void onReset(bool hard_reset) override;
+
+  /// Access internal details.
+  /// @return Internal details.
+  NearestNeighboursBatchDetail *imp();
+  /// Access internal details.
+  /// @return Internal details.
+  const NearestNeighboursBatchDetail *imp() const;
+};
+}  // namespace ohm
+
+#endif  // OHM_NEARESTNEIGHBOURSBATCH_H
@@ -12,31 +12,106 @@
 #include "MapChunk.h"
 #include "MapCoord.h"
 #include "MapLayer.h"
+#include "MapMemoryAccounting.h"
 #include "MapProbability.h"
 #include "MapRegionCache.h"
+#include "MapSerialise.h"
+#include "MemoryTrack.h"
+#include "Metrics.h"
 #include "RayMapperOccupancy.h"
+#include "RegionStatistics.h"
+#include "TaskArena.h"
 #include "VoxelBlockCompressionQueue.h"
 #include "VoxelBuffer.h"
+#include "VoxelMemoryPool.h"
 #include "VoxelOccupancy.h"
 
 #include "OccupancyUtil.h"
 
+#include "private/IndexedMapFile.h"
 #include "private/OccupancyMapDetail.h"
+#include "private/RegionPager.h"
+#include "private/RollingWindow.h"
+
+#include <logutil/Logger.h>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #ifdef OHM_VALIDATION
 #include <cstdio>
 #endif  // OHM_VALIDATION
 #include <cstring>
 #include <functional>
 #include <limits>
+#include <unordered_set>
 #include <utility>
 
 namespace ohm
 {
 namespace
 {
+/// Fraction of the region paging budget to page out down to once the budget is exceeded.
+const double kRegionPagingLowTide = 0.9;
+
+/// Update the @c MapChunk::access_stamp for region paging. Only writes the stamp once per epoch to minimise
+/// contention.
+inline void updateAccessStamp(MapChunk &chunk, const RegionPager &pager)
+{
+  const uint64_t epoch = pager.epoch();
+  if (chunk.access_stamp.load(std::memory_order_relaxed) != epoch)
+  {
+    chunk.access_stamp.store(epoch, std::memory_order_relaxed);
+  }
+}
+
+/// Calculate the minimum region key of a rolling window with the given @p dimensions centred on @p centre_key .
+inline glm::i16vec3 rollingWindowMinKey(const glm::i16vec3 &centre_key, const glm::ivec3 &dimensions)
+{
+  return glm::i16vec3(glm::ivec3(centre_key) - dimensions / 2);
+}
+
+/// Retain a culled @p chunk as a spare in the rolling @p window if it occupies a window slot, so it is recycled by the
+/// next region created in that slot.
+/// @return True if the chunk is retained and must not be released.
+inline bool retainWindowChunk(RollingWindow *window, const MapChunk *chunk)
+{
+  if (!window)
+  {
+    return false;
+  }
+
+  std::unique_lock<Mutex> guard(window->mutex());
+  RollingWindow::Slot &slot = window->slot(chunk->region.coord);
+  if (slot.chunk == chunk)
+  {
+    slot.spare = true;
+    return true;
+  }
+  return false;
+}
+
+/// Forget a detached @p chunk from its rolling @p window slot, if any, so the slot does not reference released memory.
+inline void forgetWindowChunk(RollingWindow *window, const MapChunk *chunk)
+{
+  if (!window)
+  {
+    return;
+  }
+
+  std::unique_lock<Mutex> guard(window->mutex());
+  RollingWindow::Slot &slot = window->slot(chunk->region.coord);
+  if (slot.chunk == chunk)
+  {
+    slot = RollingWindow::Slot{};
+  }
+}
+
 inline Key firstKeyForChunk(const OccupancyMapDetail &map, const MapChunk &chunk)
 {
 #ifdef OHM_VALIDATION
@@ -112,7 +187,6 @@ OccupancyMap::base_iterator::base_iterator(OccupancyMap *map, const Key &key)  /
   ChunkMap::iterator &chunk_iter = initChunkIter(chunk_mem_.data());
   if (!key.isNull())
   {
-    std::unique_lock<decltype(map->detail()->mutex)> guard(map->detail()->mutex);
     chunk_iter = map->detail()->chunks.find(key.regionKey());
   }
 }
@@ -194,6 +268,8 @@ OccupancyMap::OccupancyMap(double resolution, const glm::u8vec3 &region_voxel_di
 {
   // Start the voxel map compression queue thread.
   VoxelBlockCompressionQueue::instance().retain();
+  imp_->memory_pool = std::make_shared<VoxelMemoryPool>();
+  imp_->memory_accounting = std::make_shared<MapMemoryAccounting>();
   imp_->resolution = resolution;
   imp_->region_voxel_dimensions.x =
     (region_voxel_dimensions.x > 0) ? region_voxel_dimensions.x : OHM_DEFAULT_CHUNK_DIM_X;
@@ -204,6 +280,7 @@ OccupancyMap::OccupancyMap(double resolution, const glm::u8vec3 &region_voxel_di
   imp_->region_spatial_dimensions.x = imp_->region_voxel_dimensions.x * resolution;
   imp_->region_spatial_dimensions.y = imp_->region_voxel_dimensions.y * resolution;
   imp_->region_spatial_dimensions.z = imp_->region_voxel_dimensions.z * resolution;
+  imp_->region_indexer = RegionIndexer(imp_->region_voxel_dimensions);
   imp_->saturate_at_min_value = imp_->saturate_at_max_value = false;
   // Default min/max thresholds taken from octomap as a guide.
   imp_->min_voxel_value = -2.0f;   // NOLINT(readability-magic-numbers)
@@ -216,6 +293,23 @@ OccupancyMap::OccupancyMap(double resolution, const glm::u8vec3 &region_voxel_di
     const double large_long_ray_limit = 1e10;
     return ohm::goodRayFilter(start, end, filter_flags, large_long_ray_limit);
   };
+  imp_->ray_batch_filter = [](glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count) {
+    const double large_long_ray_limit = 1e10;
+    ohm::goodRayBatchFilter(rays, filter_flags, ray_count, large_long_ray_limit);
+  };
+
+  if (!voxelOrderSupported(voxelOrderFromFlags(flags), glm::ivec3(imp_->region_voxel_dimensions)))
+  {
+    logutil::warn("Voxel order not supported by region dimensions ", int(imp_->region_voxel_dimensions.x), ',',
+                  int(imp_->region_voxel_dimensions.y), ',', int(imp_->region_voxel_dimensions.z),
+                  ". Using row major voxel order.\n");
+    flags &= ~kVoxelOrderFlags;
+  }
+  else if (voxelOrderFromFlags(flags) == VoxelOrder::kMorton)
+  {
+    // Ensure a single order flag.
+    flags &= ~MapFlag::kVoxelOrderBrick4;
+  }
 
   imp_->flags = flags;
   imp_->setDefaultLayout(flags);
@@ -292,7 +386,8 @@ size_t OccupancyMap::calculateApproximateMemory() const
     for (unsigned i = 0; i < imp_->layout.layerCount(); ++i)
     {
       const MapLayer &layer = imp_->layout.layer(i);
-      byte_count += chunk_count * layer.layerByteSize(imp_->region_voxel_dimensions);
+      // Group member voxels are held by the group layer.
+      byte_count += (!layer.isGroupMember()) ? chunk_count * layer.layerByteSize(imp_->region_voxel_dimensions) : 0u;
     }
 
     // Approximate hash map usage.
@@ -315,6 +410,196 @@ size_t OccupancyMap::calculateApproximateMemory() const
   return byte_count;
 }
 
+VoxelMemoryPool &OccupancyMap::voxelMemoryPool() const
+{
+  return *imp_->memory_pool;
+}
+
+MapMemoryAccounting &OccupancyMap::memoryAccounting() const
+{
+  return *imp_->memory_accounting;
+}
+
+MapMemoryUsage OccupancyMap::memoryUsage() const
+{
+  return imp_->memory_accounting->usage(unsigned(imp_->layout.layerCount()));
+}
+
+void OccupancyMap::setMemoryBudget(size_t budget, const MemoryBudgetFunction &on_exceeded)
+{
+  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+  imp_->memory_accounting->setBudget(budget);
+  imp_->on_memory_budget = on_exceeded;
+}
+
+size_t OccupancyMap::memoryBudget() const
+{
+  return imp_->memory_accounting->budget();
+}
+
+bool OccupancyMap::enforceMemoryBudget()
+{
+  MapMemoryAccounting &accounting = *imp_->memory_accounting;
+  if (!accounting.overBudget())
+  {
+    return true;
+  }
+
+  if ((imp_->flags & MapFlag::kCompressed) == MapFlag::kCompressed)
+  {
+    // Compress ahead of the background compression thread. Retained blocks fail to compress and are skipped.
+    std::vector<uint8_t> compression_buffer;
+    memorytrack::BufferTracker buffer_track(MemorySubsystem::kCompression);
+    for (auto &&chunk_ref : imp_->chunks)
+    {
+      MapChunk &chunk = *chunk_ref.second;
+      for (auto &voxel_block : chunk.voxel_blocks)
+      {
+        if (voxel_block)
+        {
+          voxel_block->compressWithTemporaryBuffer(compression_buffer);
+          buffer_track.track(compression_buffer);
+        }
+        if (!accounting.overBudget())
+        {
+          return true;
+        }
+      }
+    }
+  }
+
+  MemoryBudgetFunction on_exceeded;
+  {
+    std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+    on_exceeded = imp_->on_memory_budget;
+  }
+
+  if (on_exceeded)
+  {
+    on_exceeded(*this, memoryUsage());
+  }
+
+  return !accounting.overBudget();
+}
+
+size_t OccupancyMap::prefetchRegions(const glm::i16vec3 *region_keys, size_t region_count) const
+{
+  if ((imp_->flags & MapFlag::kCompressed) != MapFlag::kCompressed)
+  {
+    return 0;
+  }
+
+  VoxelBlockCompressionQueue &compressor = VoxelBlockCompressionQueue::instance();
+  size_t queued_count = 0;
+  for (size_t i = 0; i < region_count; ++i)
+  {
+    // Lock-free lookup. Do not page in or create regions.
+    const MapChunk *chunk = imp_->chunks.lookup(region_keys[i]);
+    if (!chunk)
+    {
+      continue;
+    }
+
+    for (const auto &voxel_block : chunk->voxel_blocks)
+    {
+      if (voxel_block && compressor.prefetch(voxel_block.get()))
+      {
+        ++queued_count;
+      }
+    }
+  }
+
+  return queued_count;
+}
+
+size_t OccupancyMap::prefetchRegions(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext) const
+{
+  if ((imp_->flags & MapFlag::kCompressed) != MapFlag::kCompressed)
+  {
+    return 0;
+  }
+
+  const glm::i16vec3 min_region = regionKey(min_ext);
+  const glm::i16vec3 max_region = regionKey(max_ext);
+  std::vector<glm::i16vec3> region_keys;
+  glm::i16vec3 region_key;
+  for (int z = min_region.z; z <= max_region.z; ++z)
+  {
+    region_key.z = int16_t(z);
+    for (int y = min_region.y; y <= max_region.y; ++y)
+    {
+      region_key.y = int16_t(y);
+      for (int x = min_region.x; x <= max_region.x; ++x)
+      {
+        region_key.x = int16_t(x);
+        region_keys.emplace_back(region_key);
+      }
+    }
+  }
+
+  return prefetchRegions(region_keys.data(), region_keys.size());
+}
+
+size_t OccupancyMap::prefetchRays(const glm::dvec3 *rays, size_t element_count) const
+{
+  if ((imp_->flags & MapFlag::kCompressed) != MapFlag::kCompressed)
+  {
+    return 0;
+  }
+
+  const glm::dvec3 &region_dim = imp_->region_spatial_dimensions;
+  const double sample_step = 0.5 * std::min(region_dim.x, std::min(region_dim.y, region_dim.z));
+  // Collect unique regions in ray order so the earliest rays are prefetched first.
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> region_set;
+  std::vector<glm::i16vec3> region_keys;
+  const auto add_region = [&](const glm::dvec3 &point) {
+    const glm::i16vec3 region_key = regionKey(point);
+    if (region_set.insert(region_key).second)
+    {
+      region_keys.emplace_back(region_key);
+    }
+  };
+
+  for (size_t i = 0; i + 1 < element_count; i += 2)
+  {
+    const glm::dvec3 &origin = rays[i + 0];
+    const glm::dvec3 &sample = rays[i + 1];
+    const auto steps = size_t(std::ceil(glm::length(sample - origin) / sample_step));
+    for (size_t s = 0; s < steps; ++s)
+    {
+      add_region(origin + (sample - origin) * (double(s) / double(steps)));
+    }
+    add_region(sample);
+  }
+
+  return prefetchRegions(region_keys.data(), region_keys.size());
+}
+
+void OccupancyMap::updateCompressionPriority(const glm::dvec3 &reference_position, double protect_radius,
+                                             const glm::i16vec3 *protected_regions, size_t protected_region_count)
+{
+  if ((imp_->flags & MapFlag::kCompressed) != MapFlag::kCompressed)
+  {
+    return;
+  }
+
+  const std::unordered_set<glm::i16vec3, MapRegion::Hash> protected_set(protected_regions,
+                                                                        protected_regions + protected_region_count);
+  for (auto &&chunk_ref : imp_->chunks)
+  {
+    MapChunk &chunk = *chunk_ref.second;
+    const double distance = glm::length(regionSpatialCentre(chunk.region.coord) - reference_position);
+    const bool protect = distance <= protect_radius || protected_set.find(chunk.region.coord) != protected_set.end();
+    for (auto &voxel_block : chunk.voxel_blocks)
+    {
+      if (voxel_block)
+      {
+        voxel_block->setCompressionHint(float(distance), protect);
+      }
+    }
+  }
+}
+
 double OccupancyMap::resolution() const
 {
   return imp_->resolution;
@@ -356,6 +641,11 @@ glm::u8vec3 OccupancyMap::regionVoxelDimensions() const
   return imp_->region_voxel_dimensions;
 }
 
+const RegionIndexer &OccupancyMap::regionIndexer() const
+{
+  return imp_->region_indexer;
+}
+
 size_t OccupancyMap::regionVoxelVolume() const
 {
   size_t v = imp_->region_voxel_dimensions.x;
@@ -394,11 +684,142 @@ const glm::dvec3 &OccupancyMap::origin() const
   return imp_->origin;
 }
 
+namespace
+{
+/// Calculate the region coordinate of @p point along @p axis without the 16-bit region key limit.
+double unboundedRegionCoord(const OccupancyMapDetail &imp, const glm::dvec3 &point, int axis)
+{
+  return std::floor((point[axis] - imp.origin[axis]) / imp.region_spatial_dimensions[axis] + 0.5);
+}
+}  // namespace
+
+bool OccupancyMap::shiftRegionKey(glm::i16vec3 &region_key, const glm::dvec3 &region_shift)
+{
+  const double key_min = std::numeric_limits<int16_t>::min();
+  const double key_max = std::numeric_limits<int16_t>::max();
+  const glm::dvec3 coord = glm::dvec3(region_key) - region_shift;
+  if (coord.x < key_min || coord.x > key_max || coord.y < key_min || coord.y > key_max || coord.z < key_min ||
+      coord.z > key_max)
+  {
+    return false;
+  }
+
+  region_key = glm::i16vec3(coord);
+  return true;
+}
+
+
+bool OccupancyMap::rebaseOrigin(const glm::dvec3 &centre, size_t *removed_count, bool remove_out_of_range)
+{
+  if (removed_count)
+  {
+    *removed_count = 0;
+  }
+
+  if (imp_->pager || imp_->rolling_window || imp_->indexed_file)
+  {
+    logutil::warn("Map origin rebasing is not supported with region paging, rolling window or indexed maps\n");
+    return false;
+  }
+
+  const glm::dvec3 shift(unboundedRegionCoord(*imp_, centre, 0), unboundedRegionCoord(*imp_, centre, 1),
+                         unboundedRegionCoord(*imp_, centre, 2));
+  if (shift == glm::dvec3(0))
+  {
+    return true;
+  }
+
+  std::vector<MapChunk *> chunks;
+  {
+    std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+    if (!remove_out_of_range)
+    {
+      // Fail before modifying the map if any region would leave the key range.
+      for (auto &&chunk_ref : imp_->chunks)
+      {
+        glm::i16vec3 region_key = chunk_ref.second->region.coord;
+        if (!shiftRegionKey(region_key, shift))
+        {
+          logutil::warn("Map origin rebase would remove regions outside the key range\n");
+          return false;
+        }
+      }
+    }
+
+    // The GPU cache references the chunks by region key.
+    if (imp_->gpu_cache)
+    {
+      imp_->gpu_cache->clear();
+    }
+
+    chunks.reserve(imp_->chunks.size());
+    for (auto &&chunk_ref : imp_->chunks)
+    {
+      chunks.emplace_back(chunk_ref.second);
+    }
+    imp_->chunks.clear();
+
+    auto keep_iter = chunks.begin();
+    for (MapChunk *chunk : chunks)
+    {
+      if (!shiftRegionKey(chunk->region.coord, shift))
+      {
+        releaseChunk(chunk);
+        continue;
+      }
+
+      chunk->region.centre = regionCentreLocal(chunk->region.coord);
+      imp_->chunks.insert(chunk->region.coord, chunk);
+      *keep_iter++ = chunk;
+    }
+
+    if (removed_count)
+    {
+      *removed_count = size_t(chunks.end() - keep_iter);
+    }
+    chunks.erase(keep_iter, chunks.end());
+
+    imp_->origin += shift * imp_->region_spatial_dimensions;
+    imp_->rebase_offset += shift;
+  }
+
+  // Publish the rebase before flagging the re-keyed regions so subscribers see the new keys as changes.
+  imp_->notifyRebase(shift);
+
+  const uint64_t stamp = touch();
+  for (MapChunk *chunk : chunks)
+  {
+    chunk->markDirty(stamp);
+  }
+
+  return true;
+}
+
+
+glm::dvec3 OccupancyMap::rebaseOffset() const
+{
+  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+  return imp_->rebase_offset;
+}
+
+
+int OccupancyMap::regionKeyHeadroom(const glm::dvec3 &point) const
+{
+  double headroom = std::numeric_limits<int16_t>::max();
+  for (int i = 0; i < 3; ++i)
+  {
+    const double coord = unboundedRegionCoord(*imp_, point, i);
+    headroom = std::min(headroom, (coord >= 0) ? std::numeric_limits<int16_t>::max() - coord :
+                                                 coord - std::numeric_limits<int16_t>::min());
+  }
+  // Clamp to the int range for points very far outside the map.
+  return int(std::max(headroom, double(std::numeric_limits<int>::min())));
+}
+
 bool OccupancyMap::calculateExtents(glm::dvec3 *min_ext, glm::dvec3 *max_ext, KeyRange *key_range) const
 {
   glm::dvec3 region_min;
   glm::dvec3 region_max;
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
   // Empty map if there are no chunks or the voxel dimensions are zero (latter just shouldn't happen).
   if (imp_->chunks.empty() || glm::any(glm::equal(imp_->region_voxel_dimensions, glm::u8vec3(0))))
   {
@@ -493,6 +914,79 @@ bool OccupancyMap::calculateExtents(glm::dvec3 *min_ext, glm::dvec3 *max_ext, Ke
   return valid;
 }
 
+MapStatistics OccupancyMap::calculateStatistics() const
+{
+  MapStatistics stats;
+  const glm::ivec3 region_dim(imp_->region_voxel_dimensions);
+  // Track the observed extents as global voxel coordinates.
+  glm::ivec3 min_voxel(std::numeric_limits<int>::max());
+  glm::ivec3 max_voxel(std::numeric_limits<int>::min());
+
+  stats.region_count = imp_->chunks.size();
+  for (auto &&chunk_entry : imp_->chunks)
+  {
+    MapChunk &chunk = *chunk_entry.second;
+    bool rebuilt = false;
+    const RegionStatistics *region_stats = updateRegionStatistics(chunk, &rebuilt);
+    if (!region_stats)
+    {
+      continue;
+    }
+
+    stats.rebuilt_region_count += !!rebuilt;
+    stats.occupied_count += region_stats->occupied_count;
+    stats.free_count += region_stats->free_count;
+    stats.unobserved_count += region_stats->unobserved_count;
+    if (region_stats->observed())
+    {
+      ++stats.observed_region_count;
+      const glm::ivec3 region_origin = glm::ivec3(chunk.region.coord) * region_dim;
+      min_voxel = glm::min(min_voxel, region_origin + region_stats->min_observed);
+      max_voxel = glm::max(max_voxel, region_origin + region_stats->max_observed);
+    }
+  }
+
+  if (stats.observed())
+  {
+    const auto to_key = [&region_dim](const glm::ivec3 &voxel) {
+      glm::ivec3 region_coord;
+      for (int i = 0; i < 3; ++i)
+      {
+        // Round towards negative infinity.
+        region_coord[i] =
+          (voxel[i] >= 0) ? voxel[i] / region_dim[i] : -((region_dim[i] - 1 - voxel[i]) / region_dim[i]);
+      }
+      return Key(glm::i16vec3(region_coord), glm::u8vec3(voxel - region_coord * region_dim));
+    };
+    const Key min_key = to_key(min_voxel);
+    const Key max_key = to_key(max_voxel);
+    stats.observed_keys = KeyRange(min_key, max_key, imp_->region_voxel_dimensions);
+    const glm::dvec3 half_voxel(0.5 * imp_->resolution);
+    stats.min_observed = voxelCentreGlobal(min_key) - half_voxel;
+    stats.max_observed = voxelCentreGlobal(max_key) + half_voxel;
+  }
+
+  return stats;
+}
+
+bool OccupancyMap::calculateObservedExtents(glm::dvec3 *min_ext, glm::dvec3 *max_ext, KeyRange *key_range) const
+{
+  const MapStatistics stats = calculateStatistics();
+  if (min_ext)
+  {
+    *min_ext = stats.min_observed;
+  }
+  if (max_ext)
+  {
+    *max_ext = stats.max_observed;
+  }
+  if (key_range)
+  {
+    *key_range = stats.observed_keys;
+  }
+  return stats.observed();
+}
+
 MapInfo &OccupancyMap::mapInfo()
 {
   return imp_->info;
@@ -508,6 +1002,18 @@ MapFlag OccupancyMap::flags() const
   return imp_->flags;
 }
 
+VoxelOrder OccupancyMap::voxelOrder() const
+{
+  return voxelOrderFromFlags(imp_->flags);
+}
+
+VoxelOrder OccupancyMap::layerVoxelOrder(int layer_index) const
+{
+  const MapLayer *layer = (layer_index >= 0) ? imp_->layout.layerPtr(layer_index) : nullptr;
+  return (layer) ? resolveVoxelOrder(voxelOrder(), glm::ivec3(layer->dimensions(imp_->region_voxel_dimensions))) :
+                   VoxelOrder::kRowMajor;
+}
+
 const MapLayout &OccupancyMap::layout() const
 {
   return imp_->layout;
@@ -598,27 +1104,47 @@ bool OccupancyMap::incidentNormalEnabled() const
 }
 
 
-void OccupancyMap::addLayer(const char *layer_name, const std::function<void(MapLayout &)> &add_layer_function)
+void OccupancyMap::addTouchIncidentLayer()
 {
-  if (imp_->layout.layerIndex(layer_name) >= 0)
+  if (touchIncidentEnabled())
   {
     // Already present.
     return;
   }
 
   MapLayout layout = imp_->layout;
-  add_layer_function(layout);
+  addTouchIncident(layout);
   updateLayout(layout);
 }
 
 
-void OccupancyMap::updateLayout(const MapLayout &new_layout, bool preserve_map)
+bool OccupancyMap::touchIncidentEnabled() const
 {
-  // First check if there is a difference between the @c MapLayout and the actual layout.
-  // There's no work to do otherwise.
+  return imp_->layout.layerIndex(default_layer::touchIncidentLayerName()) >= 0;
+}
 
-  const MapLayoutMatch match = imp_->layout.checkEquivalent(new_layout);
-  if (match == MapLayoutMatch::kExact)
+
+void OccupancyMap::addLayer(const char *layer_name, const std::function<void(MapLayout &)> &add_layer_function)
+{
+  if (imp_->layout.layerIndex(layer_name) >= 0)
+  {
+    // Already present.
+    return;
+  }
+
+  MapLayout layout = imp_->layout;
+  add_layer_function(layout);
+  updateLayout(layout);
+}
+
+
+void OccupancyMap::updateLayout(const MapLayout &new_layout, bool preserve_map)
+{
+  // First check if there is a difference between the @c MapLayout and the actual layout.
+  // There's no work to do otherwise.
+
+  const MapLayoutMatch match = imp_->layout.checkEquivalent(new_layout);
+  if (match == MapLayoutMatch::kExact)
   {
     // Already matches the current layout. Nothing to do.
     return;
@@ -634,12 +1160,25 @@ void OccupancyMap::updateLayout(const MapLayout &new_layout, bool preserve_map)
 
   // We have a memory change. A full update is required.
 
+  // Regions paged out of memory must be updated too. The pager slot size changes with the layout.
+  if (preserve_map)
+  {
+    pageInAllRegions();
+  }
+  const std::string pager_path = (imp_->pager) ? imp_->pager->path() : std::string();
+
   // First we have to synchronise the GPU cache(s).
   if (imp_->gpu_cache)
   {
     imp_->gpu_cache->clear();
   }
 
+  // Chunks retained for recycling by the rolling window are not worth migrating.
+  if (imp_->rolling_window)
+  {
+    imp_->rolling_window->releaseSpares(&OccupancyMap::releaseChunk);
+  }
+
   if (preserve_map)
   {
     /// Tracking of layer indices to preserve. First item is the layer index in the current layout, while the second is
@@ -661,11 +1200,31 @@ void OccupancyMap::updateLayout(const MapLayout &new_layout, bool preserve_map)
       }
     }
 
-    // Walk the chunks preserving which layers we can.
+    // Migrate the chunks preserving which layers we can. Chunks are independent, so migrate in parallel.
+    std::vector<MapChunk *> chunks;
+    chunks.reserve(imp_->chunks.size());
     for (auto &chunk : imp_->chunks)
     {
-      chunk.second->updateLayout(&new_layout, layer_mapping);
+      chunks.emplace_back(chunk.second);
     }
+
+    const auto migrate_chunks = [&chunks, &new_layout, &layer_mapping](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i)
+      {
+        chunks[i]->updateLayout(&new_layout, layer_mapping);
+      }
+    };
+
+#ifdef OHM_FEATURE_THREADS
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, chunks.size()),
+                        [&migrate_chunks](const tbb::blocked_range<size_t> &range) {
+                          migrate_chunks(range.begin(), range.end());
+                        });
+    });
+#else   // OHM_FEATURE_THREADS
+    migrate_chunks(0, chunks.size());
+#endif  // OHM_FEATURE_THREADS
   }
   else
   {
@@ -674,6 +1233,12 @@ void OccupancyMap::updateLayout(const MapLayout &new_layout, bool preserve_map)
 
   imp_->layout = new_layout;
 
+  if (imp_->pager)
+  {
+    // Recreate the backing file for the new slot size.
+    imp_->pager->open(pager_path, *imp_);
+  }
+
   // Now reallocate any GPU cache which relies on the occupancy layer.
   if (imp_->gpu_cache)
   {
@@ -684,7 +1249,6 @@ void OccupancyMap::updateLayout(const MapLayout &new_layout, bool preserve_map)
 
 size_t OccupancyMap::regionCount() const
 {
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
   return imp_->chunks.size();
 }
 
@@ -720,6 +1284,72 @@ unsigned OccupancyMap::cullRegionsOutside(const glm::dvec3 &min_extents, const g
   return cullRegions(should_remove_chunk);
 }
 
+size_t OccupancyMap::preallocateRegions(const Aabb &extents)
+{
+  const glm::ivec3 min_key(regionKey(extents.minExtents()));
+  const glm::ivec3 max_key(regionKey(extents.maxExtents()));
+  size_t created_count = 0;
+  glm::ivec3 key;
+  for (key.z = min_key.z; key.z <= max_key.z; ++key.z)
+  {
+    for (key.y = min_key.y; key.y <= max_key.y; ++key.y)
+    {
+      for (key.x = min_key.x; key.x <= max_key.x; ++key.x)
+      {
+        created_count += preallocateRegion(glm::i16vec3(key));
+      }
+    }
+  }
+  return created_count;
+}
+
+size_t OccupancyMap::preallocateAlongPath(const std::vector<glm::dvec3> &path, double radius)
+{
+  if (path.empty())
+  {
+    return 0;
+  }
+
+  radius = std::max(radius, 0.0);
+  // Select regions by bounding sphere.
+  const double region_radius = 0.5 * glm::length(imp_->region_spatial_dimensions);
+  const double select_range_sqr = (radius + region_radius) * (radius + region_radius);
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> visited;
+  size_t created_count = 0;
+  // A single point is treated as a zero length segment.
+  const size_t segment_count = std::max<size_t>(path.size() - 1, 1u);
+  for (size_t i = 0; i < segment_count; ++i)
+  {
+    const glm::dvec3 &from = path[i];
+    const glm::dvec3 &to = path[std::min(i + 1, path.size() - 1)];
+    const glm::dvec3 segment = to - from;
+    const double segment_length_sqr = glm::dot(segment, segment);
+    const glm::ivec3 min_key(regionKey(glm::min(from, to) - glm::dvec3(radius)));
+    const glm::ivec3 max_key(regionKey(glm::max(from, to) + glm::dvec3(radius)));
+    glm::ivec3 key;
+    for (key.z = min_key.z; key.z <= max_key.z; ++key.z)
+    {
+      for (key.y = min_key.y; key.y <= max_key.y; ++key.y)
+      {
+        for (key.x = min_key.x; key.x <= max_key.x; ++key.x)
+        {
+          const glm::i16vec3 region_key(key);
+          const glm::dvec3 centre = regionCentreGlobal(region_key);
+          const double t = (segment_length_sqr > 0) ?
+                             glm::clamp(glm::dot(centre - from, segment) / segment_length_sqr, 0.0, 1.0) :
+                             0.0;
+          const glm::dvec3 separation = centre - (from + t * segment);
+          if (glm::dot(separation, separation) <= select_range_sqr && visited.insert(region_key).second)
+          {
+            created_count += preallocateRegion(region_key);
+          }
+        }
+      }
+    }
+  }
+  return created_count;
+}
+
 void OccupancyMap::touchRegionTimestampByKey(const glm::i16vec3 &region_key, double timestamp, bool allow_create)
 {
   MapChunk *chunk = region(region_key, allow_create);
@@ -803,7 +1433,23 @@ float OccupancyMap::occupancyThresholdProbability() const
 
 void OccupancyMap::setOccupancyThresholdProbability(float probability)
 {
-  imp_->occupancy_threshold_value = probabilityToValue(probability);
+  const float threshold_value = probabilityToValue(probability);
+  if (threshold_value == imp_->occupancy_threshold_value)
+  {
+    return;
+  }
+  imp_->occupancy_threshold_value = threshold_value;
+
+  // The occupancy state layer is derived using the threshold. Clear its stamps to mark it stale in every region.
+  const int state_layer = imp_->layout.layerIndex(default_layer::occupancyStateLayerName());
+  if (state_layer >= 0)
+  {
+    std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+    for (auto &&chunk_ref : imp_->chunks)
+    {
+      chunk_ref.second->touched_stamps[state_layer].store(0u, std::memory_order_relaxed);
+    }
+  }
 }
 
 float OccupancyMap::minVoxelValue() const
@@ -846,6 +1492,16 @@ void OccupancyMap::setSaturateAtMaxValue(bool saturate)
   imp_->saturate_at_max_value = saturate;
 }
 
+double OccupancyMap::occupancyDecayTime() const
+{
+  return imp_->occupancy_decay_time;
+}
+
+void OccupancyMap::setOccupancyDecayTime(double decay_time)
+{
+  imp_->occupancy_decay_time = std::max(decay_time, 0.0);
+}
+
 glm::dvec3 OccupancyMap::voxelCentreLocal(const Key &key) const
 {
   return ohm::OccupancyMap::voxelCentre(key, imp_->resolution, imp_->region_spatial_dimensions);
@@ -885,6 +1541,77 @@ Key OccupancyMap::voxelKey(const glm::dvec3 &point) const
   return key;
 }
 
+namespace
+{
+/// Relative distance from a quantisation boundary within which @c OccupancyMap::voxelKeys() defers to the division
+/// based calculation. Well above the difference between multiplying by a reciprocal and dividing.
+constexpr double kVoxelKeysBoundaryTolerance = 1e-9;
+
+/// Quantise @p scaled - a coordinate multiplied by a reciprocal cell size - by flooring it.
+/// @param scaled The scaled coordinate.
+/// @param[out] quantised The quantised value.
+/// @return False when @p scaled is too close to a cell boundary to be sure the result matches division.
+inline bool quantiseScaled(double scaled, int &quantised)
+{
+  const double floored = std::floor(scaled);
+  const double tolerance = kVoxelKeysBoundaryTolerance * (1.0 + std::abs(scaled));
+  quantised = int(floored);
+  return scaled - floored > tolerance && floored + 1.0 - scaled > tolerance;
+}
+}  // namespace
+
+void OccupancyMap::voxelKeys(const glm::dvec3 *points, size_t count, Key *keys) const
+{
+  const glm::dvec3 origin = imp_->origin;
+  const glm::dvec3 region_dimensions = imp_->region_spatial_dimensions;
+  const glm::dvec3 region_scale = 1.0 / region_dimensions;
+  const double voxel_scale = 1.0 / imp_->resolution;
+  const glm::ivec3 voxel_counts = imp_->region_voxel_dimensions;
+  // Matches the epsilon in pointToRegionVoxel().
+  const double epsilon = double(1e-6f);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const glm::dvec3 map_point = points[i] - origin;
+    bool exact = true;
+    glm::ivec3 region;
+    glm::ivec3 voxel;
+    for (int a = 0; a < 3; ++a)
+    {
+      // Region quantisation as per pointToRegionCoord().
+      exact = quantiseScaled(map_point[a] * region_scale[a] + 0.5, region[a]) && exact;
+      // Localise and quantise the voxel as per MapRegion::voxelKey() and pointToRegionVoxel().
+      const double region_min = int16_t(region[a]) * region_dimensions[a] - 0.5 * region_dimensions[a];
+      double coord = points[i][a] - origin[a] - region_min;
+      if (-epsilon <= coord && coord < 0)
+      {
+        coord = 0;
+      }
+      else if (coord >= region_dimensions[a] && coord - epsilon < region_dimensions[a])
+      {
+        coord -= epsilon;
+      }
+      exact = quantiseScaled(coord * voxel_scale, voxel[a]) && exact;
+    }
+
+    if (!exact)
+    {
+      keys[i] = voxelKey(points[i]);
+      continue;
+    }
+
+    if (0 <= voxel.x && voxel.x < voxel_counts.x && 0 <= voxel.y && voxel.y < voxel_counts.y && 0 <= voxel.z &&
+        voxel.z < voxel_counts.z)
+    {
+      keys[i] = Key(glm::i16vec3(region), glm::u8vec3(voxel));
+    }
+    else
+    {
+      keys[i] = Key::kNull;
+    }
+  }
+}
+
 Key OccupancyMap::voxelKey(const glm::vec3 &point) const
 {
   Key key;
@@ -929,6 +1656,8 @@ glm::ivec3 OccupancyMap::rangeBetween(const Key &from, const Key &to) const
 void OccupancyMap::setRayFilter(const RayFilterFunction &ray_filter)
 {
   imp_->ray_filter = ray_filter;
+  // The batch filter would otherwise take precedence over the new filter.
+  imp_->ray_batch_filter = RayBatchFilterFunction();
 }
 
 const RayFilterFunction &OccupancyMap::rayFilter() const
@@ -936,9 +1665,20 @@ const RayFilterFunction &OccupancyMap::rayFilter() const
   return imp_->ray_filter;
 }
 
+void OccupancyMap::setRayBatchFilter(const RayBatchFilterFunction &ray_batch_filter)
+{
+  imp_->ray_batch_filter = ray_batch_filter;
+}
+
+const RayBatchFilterFunction &OccupancyMap::rayBatchFilter() const
+{
+  return imp_->ray_batch_filter;
+}
+
 void OccupancyMap::clearRayFilter()
 {
   imp_->ray_filter = RayFilterFunction();
+  imp_->ray_batch_filter = RayBatchFilterFunction();
 }
 
 void OccupancyMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
@@ -958,12 +1698,15 @@ OccupancyMap *OccupancyMap::clone() const
 
 OccupancyMap *OccupancyMap::clone(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext) const
 {
+  pageInAllRegions();
+
   auto *new_map = new OccupancyMap(imp_->resolution, imp_->region_voxel_dimensions);
 
   if (imp_->ray_filter)
   {
     new_map->setRayFilter(imp_->ray_filter);
   }
+  new_map->setRayBatchFilter(imp_->ray_batch_filter);
 
   // Copy general details.
   new_map->detail()->copyFrom(*imp_);
@@ -972,6 +1715,8 @@ OccupancyMap *OccupancyMap::clone(const glm::dvec3 &min_ext, const glm::dvec3 &m
   glm::dvec3 region_max;
   const glm::dvec3 region_half_ext = 0.5 * imp_->region_spatial_dimensions;
   std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+  // Create the regions serially, then copy the voxel blocks, in parallel when available.
+  std::vector<std::pair<MapChunk *, const MapChunk *>> chunk_pairs;
   for (const auto &chunk_iter : imp_->chunks)
   {
     const MapChunk *src_chunk = chunk_iter.second;
@@ -990,7 +1735,28 @@ OccupancyMap *OccupancyMap::clone(const glm::dvec3 &min_ext, const glm::dvec3 &m
       for (unsigned i = 0; i < imp_->layout.layerCount(); ++i)
       {
         dst_chunk->touched_stamps[i] = static_cast<uint64_t>(src_chunk->touched_stamps[i]);
-        if (src_chunk->voxel_blocks[i])
+      }
+      chunk_pairs.emplace_back(dst_chunk, src_chunk);
+    }
+  }
+
+  const unsigned layer_count = unsigned(imp_->layout.layerCount());
+  const MapLayout &layout = imp_->layout;
+  const auto copy_blocks = [&chunk_pairs, &layout, layer_count](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; ++c)
+    {
+      MapChunk *dst_chunk = chunk_pairs[c].first;
+      const MapChunk *src_chunk = chunk_pairs[c].second;
+      for (unsigned i = 0; i < layer_count; ++i)
+      {
+        if (layout.layer(i).isGroupMember())
+        {
+          // Copied with the group layer.
+          continue;
+        }
+
+        // Copy the blocks as stored, sharing compressed data. Fallback to copying voxel memory.
+        if (src_chunk->voxel_blocks[i] && !dst_chunk->voxel_blocks[i]->copyFrom(*src_chunk->voxel_blocks[i]))
         {
           VoxelBuffer<const VoxelBlock> src_buffer(src_chunk->voxel_blocks[i]);
           VoxelBuffer<VoxelBlock> dst_buffer(dst_chunk->voxel_blocks[i]);
@@ -998,14 +1764,25 @@ OccupancyMap *OccupancyMap::clone(const glm::dvec3 &min_ext, const glm::dvec3 &m
         }
       }
     }
-  }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  parallelExecute([&]() {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0u, chunk_pairs.size()),
+                      [&copy_blocks](const tbb::blocked_range<size_t> &range) {
+                        copy_blocks(range.begin(), range.end());
+                      });
+  });
+#else   // OHM_FEATURE_THREADS
+  copy_blocks(0, chunk_pairs.size());
+#endif  // OHM_FEATURE_THREADS
 
   return new_map;
 }
 
 void OccupancyMap::enumerateRegions(std::vector<const MapChunk *> &chunks) const
 {
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+  chunks.reserve(chunks.size() + imp_->chunks.size());
   for (auto &&chunk_iter : imp_->chunks)
   {
     chunks.push_back(chunk_iter.second);
@@ -1014,22 +1791,63 @@ void OccupancyMap::enumerateRegions(std::vector<const MapChunk *> &chunks) const
 
 MapChunk *OccupancyMap::region(const glm::i16vec3 &region_key, bool allow_create)
 {
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
-  const auto region_search = imp_->chunks.find(region_key);
-  if (region_search != imp_->chunks.end())
+  // Lock-free lookup.
+  MapChunk *chunk = imp_->chunks.lookup(region_key);
+  if (chunk)
   {
-    MapChunk *chunk = region_search->second;
 #ifdef OHM_VALIDATION
     chunk->validateFirstValid(imp_->region_voxel_dimensions);
 #endif  // OHM_VALIDATION
+    if (imp_->pager)
+    {
+      updateAccessStamp(*chunk, *imp_->pager);
+    }
     return chunk;
   }
 
+  bool paged_out = false;
+  if (imp_->pager)
+  {
+    chunk = pageInPagedRegion(region_key, paged_out);
+    if (chunk || paged_out)
+    {
+      // Paged in or failed to page in. We must not create a replacement region for the latter.
+      return chunk;
+    }
+  }
+
+  if (imp_->indexed_file)
+  {
+    chunk = pageInRegion(region_key);
+    if (chunk)
+    {
+      return chunk;
+    }
+  }
+
   if (allow_create)
   {
-    // No such chunk. Create one.
-    MapChunk *chunk = newChunk(Key(region_key, 0, 0, 0));
-    imp_->chunks.insert(std::make_pair(chunk->region.coord, chunk));
+    if (imp_->rolling_window)
+    {
+      return newWindowRegion(region_key);
+    }
+
+    // No such chunk. Create one, but another thread may create the same chunk concurrently. The insertion resolves the
+    // race and we release our chunk if we lose.
+    MapChunk *new_chunk = newChunk(Key(region_key, 0, 0, 0));
+    if (imp_->pager)
+    {
+      new_chunk->access_stamp = imp_->pager->epoch();
+    }
+    chunk = imp_->chunks.insert(new_chunk->region.coord, new_chunk);
+    if (chunk != new_chunk)
+    {
+      releaseChunk(new_chunk);
+    }
+    else
+    {
+      metrics::coreMetrics().regions_created.add();
+    }
     // No need to touch the map here. We haven't changed the semantics of the map.
     // That happens when the value of a voxel in the region changes.
     return chunk;
@@ -1040,24 +1858,476 @@ MapChunk *OccupancyMap::region(const glm::i16vec3 &region_key, bool allow_create
 
 const MapChunk *OccupancyMap::region(const glm::i16vec3 &region_key) const
 {
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
-  const auto region_search = imp_->chunks.find(region_key);
-  if (region_search != imp_->chunks.end())
+  // Lock-free lookup.
+  MapChunk *chunk = imp_->chunks.lookup(region_key);
+  if (chunk)
   {
-    const MapChunk *chunk = region_search->second;
+    if (imp_->pager)
+    {
+      updateAccessStamp(*chunk, *imp_->pager);
+    }
     return chunk;
   }
 
+  if (imp_->pager)
+  {
+    bool paged_out = false;
+    chunk = pageInPagedRegion(region_key, paged_out);
+    if (chunk || paged_out)
+    {
+      return chunk;
+    }
+  }
+
+  if (imp_->indexed_file)
+  {
+    return pageInRegion(region_key);
+  }
+
   return nullptr;
 }
 
+void OccupancyMap::pageInAllRegions() const
+{
+  if (imp_->pager)
+  {
+    std::vector<glm::i16vec3> paged_keys;
+    imp_->pager->pagedOutKeys(paged_keys);
+    bool paged_out = false;
+    for (const auto &region_key : paged_keys)
+    {
+      pageInPagedRegion(region_key, paged_out);
+    }
+  }
+
+  if (!imp_->indexed_file)
+  {
+    return;
+  }
+
+  IndexedMapFile &file = *imp_->indexed_file;
+  for (size_t i = 0; i < file.regionCount(); ++i)
+  {
+    pageInRegion(file.region(i).coord);
+  }
+
+  // Everything is loaded. Release the file.
+  imp_->indexed_file.reset();
+}
+
+size_t OccupancyMap::enumerateIndexedRegions(std::vector<glm::i16vec3> &region_keys) const
+{
+  if (!imp_->indexed_file)
+  {
+    return 0;
+  }
+
+  const IndexedMapFile &file = *imp_->indexed_file;
+  region_keys.reserve(region_keys.size() + file.regionCount());
+  for (size_t i = 0; i < file.regionCount(); ++i)
+  {
+    region_keys.emplace_back(file.region(i).coord);
+  }
+  return file.regionCount();
+}
+
+unsigned OccupancyMap::detachRegions(const std::vector<glm::i16vec3> &region_keys, std::vector<MapChunk *> &detached)
+{
+  unsigned detached_count = 0;
+  for (const auto &region_key : region_keys)
+  {
+    if (MapChunk *chunk = detachRegion(region_key))
+    {
+      forgetWindowChunk(imp_->rolling_window.get(), chunk);
+      detached.emplace_back(chunk);
+      ++detached_count;
+    }
+  }
+  return detached_count;
+}
+
+void OccupancyMap::releaseRegions(std::vector<MapChunk *> &chunks)
+{
+  for (const MapChunk *chunk : chunks)
+  {
+    releaseChunk(chunk);
+  }
+  chunks.clear();
+}
+
+bool OccupancyMap::enableRegionPaging(const std::string &backing_file, uint64_t resident_budget, double hot_radius)
+{
+  disableRegionPaging();
+
+  auto pager = std::make_unique<RegionPager>();
+  if (!pager->open(backing_file, *imp_))
+  {
+    return false;
+  }
+
+  pager->setResidentBudget(resident_budget);
+  pager->setHotRadius(hot_radius);
+
+  // Start all existing regions in the current epoch.
+  for (auto &&chunk_ref : imp_->chunks)
+  {
+    chunk_ref.second->access_stamp = pager->epoch();
+  }
+
+  imp_->pager = std::move(pager);
+  return true;
+}
+
+void OccupancyMap::disableRegionPaging()
+{
+  if (imp_->pager)
+  {
+    pageInAllRegions();
+    imp_->pager.reset();
+  }
+}
+
+bool OccupancyMap::regionPagingEnabled() const
+{
+  return imp_->pager != nullptr;
+}
+
+uint64_t OccupancyMap::regionPagingBudget() const
+{
+  return (imp_->pager) ? imp_->pager->residentBudget() : 0u;
+}
+
+void OccupancyMap::setRegionPagingBudget(uint64_t resident_budget)
+{
+  if (imp_->pager)
+  {
+    imp_->pager->setResidentBudget(resident_budget);
+  }
+}
+
+size_t OccupancyMap::pagedOutRegionCount() const
+{
+  return (imp_->pager) ? imp_->pager->pagedOutCount() : 0u;
+}
+
+unsigned OccupancyMap::updateRegionPaging(const glm::dvec3 &hot_spot)
+{
+  if (!imp_->pager)
+  {
+    return 0;
+  }
+
+  RegionPager &pager = *imp_->pager;
+  // Advance the epoch. Regions accessed from here on are more recent than any region we page out now.
+  pager.nextEpoch();
+  const size_t max_resident =
+    std::max<size_t>(1u, size_t(pager.residentBudget() / std::max<size_t>(1u, pager.slotSize())));
+  const size_t resident = imp_->chunks.size();
+  if (resident <= max_resident)
+  {
+    return 0;
+  }
+
+  struct Candidate
+  {
+    uint64_t access_stamp;
+    double distance_sqr;
+    glm::i16vec3 region_key;
+  };
+
+  // Collect regions outside the hot radius.
+  std::vector<Candidate> candidates;
+  candidates.reserve(resident);
+  const double hot_radius_sqr = pager.hotRadius() * pager.hotRadius();
+  for (auto &&chunk_ref : imp_->chunks)
+  {
+    const MapChunk &chunk = *chunk_ref.second;
+    const glm::dvec3 separation = chunk.region.centre - hot_spot;
+    const double distance_sqr = glm::dot(separation, separation);
+    if (distance_sqr > hot_radius_sqr)
+    {
+      candidates.emplace_back(Candidate{ chunk.access_stamp, distance_sqr, chunk.region.coord });
+    }
+  }
+
+  // Least recently used first, then furthest first.
+  std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+    return a.access_stamp < b.access_stamp || a.access_stamp == b.access_stamp && a.distance_sqr > b.distance_sqr;
+  });
+
+  const auto target = size_t(double(max_resident) * kRegionPagingLowTide);
+  const size_t page_out_count = std::min(candidates.size(), resident - std::min(resident, target));
+  if (page_out_count == 0)
+  {
+    return 0;
+  }
+
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> page_out_keys;
+  page_out_keys.reserve(page_out_count);
+  for (size_t i = 0; i < page_out_count; ++i)
+  {
+    page_out_keys.insert(candidates[i].region_key);
+  }
+
+  const auto should_page_out = [this, &pager, &page_out_keys](const MapChunk &chunk) {
+    return page_out_keys.find(chunk.region.coord) != page_out_keys.end() && pager.pageOut(chunk, *imp_);
+  };
+
+  return cullRegions(should_page_out);
+}
+
+unsigned OccupancyMap::enableRollingWindow(const glm::ivec3 &region_dimensions, const glm::dvec3 &centre)
+{
+  disableRollingWindow();
+
+  const glm::ivec3 dimensions = glm::max(region_dimensions, glm::ivec3(1));
+  auto window = std::make_unique<RollingWindow>(dimensions, rollingWindowMinKey(regionKey(centre), dimensions));
+
+  // Remove regions outside the window and adopt the remaining regions into their slots.
+  const auto outside_window = [&window](const MapChunk &chunk) { return !window->contains(chunk.region.coord); };
+  const unsigned removed_count = cullRegions(outside_window);
+  for (auto &&chunk_ref : imp_->chunks)
+  {
+    window->slot(chunk_ref.second->region.coord).chunk = chunk_ref.second;
+  }
+
+  imp_->rolling_window = std::move(window);
+  return removed_count;
+}
+
+void OccupancyMap::disableRollingWindow()
+{
+  if (imp_->rolling_window)
+  {
+    imp_->rolling_window->releaseSpares(&OccupancyMap::releaseChunk);
+    imp_->rolling_window.reset();
+  }
+}
+
+bool OccupancyMap::rollingWindowEnabled() const
+{
+  return imp_->rolling_window != nullptr;
+}
+
+glm::ivec3 OccupancyMap::rollingWindowDimensions() const
+{
+  return (imp_->rolling_window) ? imp_->rolling_window->dimensions() : glm::ivec3(0);
+}
+
+bool OccupancyMap::rollingWindowKeys(glm::i16vec3 *min_key, glm::i16vec3 *max_key) const
+{
+  if (!imp_->rolling_window)
+  {
+    return false;
+  }
+
+  const RollingWindow &window = *imp_->rolling_window;
+  if (min_key)
+  {
+    *min_key = window.minKey();
+  }
+  if (max_key)
+  {
+    *max_key = glm::i16vec3(glm::ivec3(window.minKey()) + window.dimensions() - 1);
+  }
+  return true;
+}
+
+unsigned OccupancyMap::moveRollingWindow(const glm::dvec3 &centre)
+{
+  if (!imp_->rolling_window)
+  {
+    return 0;
+  }
+
+  RollingWindow &window = *imp_->rolling_window;
+  std::unique_lock<Mutex> guard(window.mutex());
+  const glm::i16vec3 min_key = rollingWindowMinKey(regionKey(centre), window.dimensions());
+  unsigned removed_count = 0;
+
+  if (min_key != window.minKey())
+  {
+    window.setMinKey(min_key);
+    // Retire the regions which have left the window. Each slot now belongs to a region which has entered the window
+    // and will recycle the retired chunk.
+    for (RollingWindow::Slot &slot : window.slots())
+    {
+      if (slot.chunk && !slot.spare && !window.contains(slot.chunk->region.coord))
+      {
+        detachRegion(slot.chunk->region.coord);
+        slot.spare = true;
+        ++removed_count;
+      }
+    }
+  }
+
+  // Resolve regions created outside the previous window.
+  for (const auto &region_key : window.outsideKeys())
+  {
+    if (!window.contains(region_key))
+    {
+      if (MapChunk *chunk = detachRegion(region_key))
+      {
+        releaseChunk(chunk);
+        ++removed_count;
+      }
+      continue;
+    }
+
+    // Now inside the window. Adopt the region into its slot, displacing any spare chunk.
+    MapChunk *chunk = imp_->chunks.lookup(region_key);
+    RollingWindow::Slot &slot = window.slot(region_key);
+    if (chunk && slot.chunk != chunk)
+    {
+      if (slot.chunk)
+      {
+        releaseChunk(slot.chunk);
+      }
+      slot.chunk = chunk;
+      slot.spare = false;
+    }
+  }
+  window.outsideKeys().clear();
+
+  return removed_count;
+}
+
+MapChunk *OccupancyMap::pageInPagedRegion(const glm::i16vec3 &region_key, bool &paged_out) const
+{
+  MapChunk *chunk = imp_->pager->pageIn(region_key, *imp_, paged_out);
+  if (!paged_out)
+  {
+    // May have been paged in by another thread.
+    return imp_->chunks.lookup(region_key);
+  }
+
+  if (!chunk)
+  {
+    logutil::error("Failed to page in region ", region_key.x, ',', region_key.y, ',', region_key.z, " from ",
+                   imp_->pager->path(), '\n');
+  }
+
+  return chunk;
+}
+
+MapChunk *OccupancyMap::newWindowRegion(const glm::i16vec3 &region_key)
+{
+  RollingWindow &window = *imp_->rolling_window;
+  std::unique_lock<Mutex> guard(window.mutex());
+  // Another thread may have created the region while we waited.
+  MapChunk *chunk = imp_->chunks.lookup(region_key);
+  if (chunk)
+  {
+    return chunk;
+  }
+
+  const Key region_origin_key(region_key, 0, 0, 0);
+  MapChunk *new_chunk = nullptr;
+  RollingWindow::Slot *slot = nullptr;
+  if (window.contains(region_key))
+  {
+    slot = &window.slot(region_key);
+    if (slot->chunk && slot->spare)
+    {
+      // Recycle the chunk which left the window from this slot.
+      new_chunk = slot->chunk;
+      new_chunk->recycle(
+        MapRegion(voxelCentreGlobal(region_origin_key), imp_->origin, imp_->region_spatial_dimensions));
+    }
+    else
+    {
+      new_chunk = newChunk(region_origin_key);
+    }
+  }
+  else
+  {
+    // Outside the window. Track for removal on the next window move.
+    new_chunk = newChunk(region_origin_key);
+    window.outsideKeys().emplace_back(region_key);
+  }
+
+  if (imp_->pager)
+  {
+    new_chunk->access_stamp = imp_->pager->epoch();
+  }
+
+  chunk = imp_->chunks.insert(region_key, new_chunk);
+  if (chunk != new_chunk)
+  {
+    // Inserted by a path which bypasses the window, such as paging in.
+    releaseChunk(new_chunk);
+  }
+  else
+  {
+    metrics::coreMetrics().regions_created.add();
+  }
+
+  if (slot)
+  {
+    slot->chunk = chunk;
+    slot->spare = false;
+  }
+
+  return chunk;
+}
+
+MapChunk *OccupancyMap::detachRegion(const glm::i16vec3 &region_key)
+{
+  MapChunk *chunk = imp_->chunks.remove(region_key);
+  if (chunk && imp_->gpu_cache)
+  {
+    std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+    imp_->gpu_cache->remove(region_key);
+  }
+  return chunk;
+}
+
+MapChunk *OccupancyMap::pageInRegion(const glm::i16vec3 &region_key) const
+{
+  IndexedMapFile &file = *imp_->indexed_file;
+  const int region_index = file.findRegion(region_key);
+  if (region_index < 0)
+  {
+    // Not in the file.
+    return nullptr;
+  }
+
+  if (!file.claim(region_index))
+  {
+    // Already loaded or being loaded by another thread.
+    file.waitLoaded(region_index);
+    return imp_->chunks.lookup(region_key);
+  }
+
+  auto *chunk = new MapChunk(*imp_);
+  const int err = file.loadRegion(region_index, *chunk, *imp_, &file.eagerLayers(), true);
+  if (err)
+  {
+    logutil::error("Failed to page in region ", region_key.x, ',', region_key.y, ',', region_key.z, ": ",
+                   serialiseErrorCodeString(err), '\n');
+    releaseChunk(chunk);
+    file.markLoaded(region_index);
+    return nullptr;
+  }
+
+  IndexedMapFile::updateFirstValid(*chunk, *imp_);
+  MapChunk *existing = imp_->chunks.insert(chunk->region.coord, chunk);
+  if (existing != chunk)
+  {
+    // Should only happen if the region was created before paging in, such as via region(key, true) after a failed
+    // page in.
+    releaseChunk(chunk);
+  }
+  file.markLoaded(region_index);
+  return existing;
+}
+
 unsigned OccupancyMap::collectDirtyRegions(uint64_t from_stamp,
                                            std::vector<std::pair<uint64_t, glm::i16vec3>> &regions) const
 {
   // Brute for for now.
   unsigned added_count = 0;
   bool added;
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
   for (auto &&chunk_ref : imp_->chunks)
   {
     if (chunk_ref.second->dirty_stamp > from_stamp)
@@ -1095,7 +2365,6 @@ uint64_t OccupancyMap::calculateDirtyExtents(uint64_t from_stamp, glm::i16vec3 *
   *min_ext = glm::i16vec3(std::numeric_limits<decltype(min_ext->x)>::max());
   *max_ext = glm::i16vec3(std::numeric_limits<decltype(min_ext->x)>::min());
 
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
   const uint64_t at_stamp = imp_->stamp;
   for (auto &&chunk_ref : imp_->chunks)
   {
@@ -1110,7 +2379,6 @@ uint64_t OccupancyMap::calculateDirtyExtents(uint64_t from_stamp, glm::i16vec3 *
       max_ext->z = std::max(chunk_ref.second->region.coord.z, max_ext->z);
     }
   }
-  guard.unlock();
 
   if (min_ext->x > max_ext->x)
   {
@@ -1126,7 +2394,6 @@ void OccupancyMap::calculateDirtyClearanceExtents(glm::i16vec3 *min_ext, glm::i1
   *min_ext = glm::i16vec3(std::numeric_limits<decltype(min_ext->x)>::max());
   *max_ext = glm::i16vec3(std::numeric_limits<decltype(min_ext->x)>::min());
 
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
   const int occupancy_layer = imp_->layout.occupancyLayer();
   const int clearance_layer = imp_->layout.clearanceLayer();
 
@@ -1146,7 +2413,6 @@ void OccupancyMap::calculateDirtyClearanceExtents(glm::i16vec3 *min_ext, glm::i1
       }
     }
   }
-  guard.unlock();
 
   if (min_ext->x > max_ext->x)
   {
@@ -1171,12 +2437,20 @@ void OccupancyMap::clear()
   }
 
   imp_->chunks.clear();
+  if (imp_->rolling_window)
+  {
+    imp_->rolling_window->clear(&OccupancyMap::releaseChunk);
+  }
+  imp_->indexed_file.reset();
+  if (imp_->pager)
+  {
+    imp_->pager->clear();
+  }
   imp_->loaded_region_count = 0;
 }
 
 Key OccupancyMap::firstIterationKey() const
 {
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
   const auto first_chunk_iter = imp_->chunks.begin();
   if (first_chunk_iter != imp_->chunks.end())
   {
@@ -1194,6 +2468,15 @@ MapChunk *OccupancyMap::newChunk(const Key &for_key)
   return chunk;
 }
 
+bool OccupancyMap::preallocateRegion(const glm::i16vec3 &region_key)
+{
+  if (imp_->chunks.lookup(region_key))
+  {
+    return false;
+  }
+  return region(region_key, true) != nullptr;
+}
+
 void OccupancyMap::releaseChunk(const MapChunk *chunk)
 {
   delete chunk;
@@ -1202,7 +2485,7 @@ void OccupancyMap::releaseChunk(const MapChunk *chunk)
 unsigned OccupancyMap::cullRegions(const RegionCullFunc &cull_func)
 {
   unsigned removed_count = 0;
-  std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
+  // Removal from the chunk map is thread safe, but access to the GPU cache must be serialised.
   auto region_iter = imp_->chunks.begin();
   const MapChunk *chunk = nullptr;
   while (region_iter != imp_->chunks.end())
@@ -1214,12 +2497,16 @@ unsigned OccupancyMap::cullRegions(const RegionCullFunc &cull_func)
       // Remove from the GPU cache.
       if (imp_->gpu_cache)
       {
+        std::unique_lock<decltype(imp_->mutex)> guard(imp_->mutex);
         imp_->gpu_cache->remove(chunk->region.coord);
       }
 
       // Culled region. Remove from the map.
       region_iter = imp_->chunks.erase(region_iter);
-      releaseChunk(chunk);
+      if (!retainWindowChunk(imp_->rolling_window.get(), chunk))
+      {
+        releaseChunk(chunk);
+      }
       ++removed_count;
     }
     else
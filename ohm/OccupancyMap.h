@@ -10,15 +10,18 @@
 
 #include "Key.h"
 #include "MapFlag.h"
+#include "MapMemoryAccounting.h"
 #include "MapProbability.h"
 #include "OccupancyType.h"
 #include "RayFilter.h"
 #include "RayFlag.h"
+#include "VoxelOrder.h"
 
 #include <glm/glm.hpp>
 
 #include <array>
 #include <functional>
+#include <string>
 #include <vector>
 
 #define OHM_DEFAULT_CHUNK_DIM_X 32
@@ -33,8 +36,12 @@ class KeyRange;
 struct MapChunk;
 class MapInfo;
 class MapLayout;
+struct MapStatistics;
 struct OccupancyMapDetail;
 class RayFilter;
+class MapMemoryAccounting;
+class RegionIndexer;
+class VoxelMemoryPool;
 
 /// A spatial container using a voxel representation of 3D space.
 ///
@@ -43,7 +50,7 @@ class RayFilter;
 /// - Fast region allocation/de-allocation
 /// - Constant lookup
 /// - Dropping regions
-/// - Eventually, out of core serialisation.
+/// - Out of core region paging - see @c enableRegionPaging() .
 ///
 /// The size of the regions is determined by the @c regionVoxelDimensions argument given on construction. Larger
 /// regions consume more memory each, but are more suited to GPU based operations. The default size of 32*32*32, or an
@@ -104,6 +111,25 @@ class RayFilter;
 /// The background compression does impose a some CPU overhead and latency especially when iterating the map as a
 /// whole to ensure voxel data are uncompressed when needed. The overhead is minimal when not using compression.
 ///
+/// @par Memory pooling
+/// Voxel layer memory is allocated from a @c VoxelMemoryPool owned by the map - see @c voxelMemoryPool() . Memory
+/// freed by removing regions, or by compressing them, is retained by the pool up to its byte limit and recycled for
+/// new regions. This avoids allocator churn when regions are continually created and culled. The voxel memory may
+/// also be packed into huge pages to reduce TLB misses for large maps - see @c HugePageAllocator .
+///
+/// @par Memory accounting
+/// The map tracks the uncompressed, compressed and GPU cached voxel memory for each layer - see @c memoryUsage() . A
+/// host memory budget may be set via @c setMemoryBudget() , allowing several maps in one process to be capped. The
+/// budget is enforced by @c enforceMemoryBudget() which first compresses voxel data, then invokes a
+/// @c MemoryBudgetFunction to page or cull regions.
+///
+/// @par Region paging
+/// Compression reduces, but does not bound the map memory usage. Region paging may be enabled via
+/// @c enableRegionPaging() to bound the number of resident regions. Least recently used regions beyond the resident
+/// budget are paged out to a backing file by @c updateRegionPaging() and transparently paged back in by @c region() .
+/// Regions near the sensor - the hot spot - are never paged out. Paging works along side compression; the resident
+/// regions may still be compressed.
+///
 /// @todo Consider ways to modify the ohm API to better support `std::shared_ptr<OccupancyMap>`. Current occupancy map
 /// usage encourages stack allocation or @c std::unique_ptr usage of the map, but then ends up passing ray pointer and
 /// marks borrowed pointers to other objects - such as a @c GpuMap . This obfuscates ownership. The plan would be to
@@ -321,6 +347,96 @@ public:
   /// @return The approximate memory usage (bytes).
   size_t calculateApproximateMemory() const;
 
+  /// Access the pool which allocates and recycles voxel layer memory for this map. The pool may be used to configure
+  /// the pool size - @c VoxelMemoryPool::setByteLimit() - or query allocation statistics.
+  /// @return The map's voxel memory pool.
+  VoxelMemoryPool &voxelMemoryPool() const;
+
+  /// Access the live voxel memory accounting for this map. See @c memoryUsage() .
+  /// @return The map's memory accounting.
+  MapMemoryAccounting &memoryAccounting() const;
+
+  /// Report the voxel memory currently used by each layer of the map. Unlike @c calculateApproximateMemory() this does
+  /// not walk the map regions.
+  /// @return The current memory usage.
+  MapMemoryUsage memoryUsage() const;
+
+  /// Set a host memory budget for the map voxel data - @c MapMemoryUsage::hostBytes() .
+  ///
+  /// The budget is enforced by @c enforceMemoryBudget() , which the CPU @c RayMapper implementations call before
+  /// integrating rays. The @p on_exceeded function is invoked when the map remains over budget after compression and
+  /// should reduce memory by paging or culling regions - e.g., using @c updateRegionPaging() or
+  /// @c removeDistanceRegions() .
+  ///
+  /// @param budget The budget (bytes). Zero disables the budget.
+  /// @param on_exceeded Optional function invoked when compression fails to meet the budget.
+  void setMemoryBudget(size_t budget, const MemoryBudgetFunction &on_exceeded = MemoryBudgetFunction());
+
+  /// Query the host memory budget. Zero when there is no budget.
+  /// @return The memory budget (bytes).
+  size_t memoryBudget() const;
+
+  /// Enforce the @c memoryBudget() . Does nothing when under budget. Otherwise all voxel data not currently retained
+  /// are compressed when using @c MapFlag::kCompressed , followed by calling the @c MemoryBudgetFunction if still
+  /// over budget.
+  ///
+  /// This is not thread safe and must not be called while other threads are accessing the map.
+  ///
+  /// @return True if the map is within its budget on return.
+  bool enforceMemoryBudget();
+
+  /// Request asynchronous decompression of the voxel data in the given regions ahead of their use. Only applies with
+  /// @c MapFlag::kCompressed ; does nothing otherwise.
+  ///
+  /// Retaining the voxel data of a compressed region decompresses it on the retaining thread, stalling map updates
+  /// and queries when revisiting previously mapped space. Prefetching queues the voxel blocks of the given regions for
+  /// decompression by the background compression thread so they are ready before the next @c RayMapper::integrateRays()
+  /// or query reaches them. Regions which are not resident in memory are skipped; prefetching neither creates regions
+  /// nor pages them in. See @c VoxelBlockCompressionQueue::prefetch() .
+  ///
+  /// Prefetching is a hint. Data which are not ready in time are decompressed on use as before, and prefetched data
+  /// may be compressed again if memory pressure is high before they are used.
+  ///
+  /// @param region_keys The regions to prefetch.
+  /// @param region_count Number of elements in @p region_keys .
+  /// @return The number of voxel blocks queued for decompression.
+  size_t prefetchRegions(const glm::i16vec3 *region_keys, size_t region_count) const;
+
+  /// Prefetch the regions overlapping a query volume. See @c prefetchRegions() .
+  /// @param min_ext The minimum extents of the volume.
+  /// @param max_ext The maximum extents of the volume.
+  /// @return The number of voxel blocks queued for decompression.
+  size_t prefetchRegions(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext) const;
+
+  /// Prefetch the regions touched by a batch of rays, such as the next batch for @c RayMapper::integrateRays() . See
+  /// @c prefetchRegions() .
+  ///
+  /// Regions are identified by sampling each ray at half the smallest region dimension, so a region clipped only at
+  /// a corner may be missed.
+  ///
+  /// @param rays Array of origin/sample point pairs.
+  /// @param element_count The number of points in @p rays . The ray count is half this value.
+  /// @return The number of voxel blocks queued for decompression.
+  size_t prefetchRays(const glm::dvec3 *rays, size_t element_count) const;
+
+  /// Update the compression hints of the map voxel data to keep the regions near a @p reference_position - generally
+  /// the sensor position - uncompressed. Only applies with @c MapFlag::kCompressed ; does nothing otherwise.
+  ///
+  /// Each voxel block is given the distance from its region centre to the @p reference_position , used by
+  /// @c CompressionPolicy::kFarthestFirst . Blocks of regions within the @p protect_radius or listed in
+  /// @p protected_regions are flagged @c VoxelBlock::kFProtected and are only compressed once no other blocks remain.
+  /// See @c VoxelBlockCompressionQueue::setPriorityPolicy() .
+  ///
+  /// Hints are not updated as the sensor moves, so this should be called periodically - e.g., with each ray batch.
+  /// Regions created after the call have a zero distance and are unprotected until the next call.
+  ///
+  /// @param reference_position The position to keep uncompressed.
+  /// @param protect_radius Regions with centres within this distance of @p reference_position are protected.
+  /// @param protected_regions Optional array of additional regions to protect.
+  /// @param protected_region_count Number of elements in @p protected_regions .
+  void updateCompressionPriority(const glm::dvec3 &reference_position, double protect_radius = 0,
+                                 const glm::i16vec3 *protected_regions = nullptr, size_t protected_region_count = 0);
+
   /// Get the voxel resolution of the occupancy map. Voxels are cubes.
   /// @return The leaf voxel resolution.
   double resolution() const;
@@ -358,6 +474,12 @@ public:
   /// @return A vector identifying the number of voxels in each region along each respective axis.
   glm::u8vec3 regionVoxelDimensions() const;
 
+  /// Access the index arithmetic for the @c regionVoxelDimensions() . This uses shift and mask arithmetic for power
+  /// of two region dimensions and is preferred over the general @c voxelIndex() and @c voxelLocalKey() functions in
+  /// hot loops.
+  /// @return The region indexer.
+  const RegionIndexer &regionIndexer() const;
+
   /// Query the total number of voxels per region.
   /// This is simply the product of the @p regionVoxelDimensions().
   /// @return The number of voxels in each region.
@@ -393,6 +515,48 @@ public:
   /// @return The map origin.
   const glm::dvec3 &origin() const;
 
+  /// Move the map origin by a whole number of regions so that the region containing @p centre has the key (0, 0, 0),
+  /// preserving the global position of all existing voxels.
+  ///
+  /// Region keys are 16-bit, limiting the map to roughly `2^16` regions along each axis. Large scale maps may rebase
+  /// as the sensor approaches that limit - see @c regionKeyHeadroom() - to keep mapping around the sensor. Existing
+  /// regions are re-keyed - see @c shiftRegionKey() . Rebasing fails, leaving the map unchanged, when any region would
+  /// fall outside the key range after the move unless @p remove_out_of_range is set, in which case those regions are
+  /// removed.
+  ///
+  /// All existing @c Key values and region keys are invalidated. Each @c RegionChangeFeed receives a rebase event -
+  /// see @c RegionChangeFeed::setRebaseCallback() - then the re-keyed regions are marked dirty so subscribers see the
+  /// new keys. @c rebaseOffset() accumulates the region key shift for consumers which poll. Any GPU cache is cleared
+  /// without synchronisation, so GPU data must be synchronised first - e.g., @c GpuMap::syncVoxels() .
+  ///
+  /// Not supported with region paging, the rolling window or maps opened via @c ohm::openIndexed() .
+  ///
+  /// @param centre The global coordinate to rebase around.
+  /// @param[out] removed_count Optionally set to the number of regions removed.
+  /// @param remove_out_of_range True to remove regions which leave the key range rather than fail.
+  /// @return True on success, false if rebasing is not supported for this map or would remove regions without
+  ///   @p remove_out_of_range .
+  bool rebaseOrigin(const glm::dvec3 &centre, size_t *removed_count = nullptr, bool remove_out_of_range = false);
+
+  /// Query the total region key shift applied by @c rebaseOrigin() over the life of this map. Consumers which cache
+  /// region keys may compare this value to detect a rebase and pass the difference to @c shiftRegionKey() .
+  /// @return The accumulated region key shift.
+  glm::dvec3 rebaseOffset() const;
+
+  /// Re-key @p region_key for a @c rebaseOrigin() with the given @p region_shift . Voxel @c Key values are re-keyed
+  /// by shifting their region key alone.
+  /// @param[in,out] region_key The region key to shift. Unchanged on failure.
+  /// @param region_shift The region key shift as reported by @c RegionChangeFeed::setRebaseCallback() or the
+  ///   difference in @c rebaseOffset() .
+  /// @return False if the shifted key falls outside the key range.
+  static bool shiftRegionKey(glm::i16vec3 &region_key, const glm::dvec3 &region_shift);
+
+  /// Query the number of regions between the region containing @p point and the limit of the region key range along
+  /// the closest axis. Negative when @p point lies outside the key range. See @c rebaseOrigin() .
+  /// @param point The global coordinate of interest.
+  /// @return The region key headroom at @p point .
+  int regionKeyHeadroom(const glm::dvec3 &point) const;
+
   /// Calculate the extents of the map based on existing regions containing known data.
   /// @param[out] min_ext Set to the minimum corner of the axis aligned extents. May be nullptr.
   /// @param[out] max_ext Set to the maximum corner of the axis aligned extents. May be nullptr.
@@ -410,6 +574,26 @@ public:
   ///   out values are undefined.
   bool calculateExtents(glm::dvec3 *min_ext, glm::dvec3 *max_ext, Key *min_key, Key *max_key = nullptr) const;
 
+  /// Gather occupancy statistics for the map: occupied, free and unobserved voxel counts along with the tight extents
+  /// of the observed voxels.
+  ///
+  /// Statistics are cached per region (see @c RegionStatistics ) and only regions with an occupancy layer modified
+  /// since the last call are re-examined, so repeated calls cost O(regions) plus the voxels of the modified regions.
+  /// Only regions resident in memory are included.
+  ///
+  /// Must not be called while the map is being modified.
+  ///
+  /// @return The map statistics.
+  MapStatistics calculateStatistics() const;
+
+  /// Calculate the tight extents of the observed voxels in the map. Unlike @c calculateExtents() , the extents bound
+  /// the observed voxels rather than the regions containing them. Uses @c calculateStatistics() .
+  /// @param[out] min_ext Set to the minimum corner of the axis aligned extents. May be nullptr.
+  /// @param[out] max_ext Set to the maximum corner of the axis aligned extents. May be nullptr.
+  /// @param[out] key_range The key range enclosing the observed voxels. May be nullptr.
+  /// @return True if the map contains observed voxels. False otherwise, in which case the out values are undefined.
+  bool calculateObservedExtents(glm::dvec3 *min_ext, glm::dvec3 *max_ext, KeyRange *key_range = nullptr) const;
+
   /// Access to the map info structure for storing general meta data.
   ///
   /// This structure is serialised with the map.
@@ -426,6 +610,20 @@ public:
   /// @return Initialisation flags.
   MapFlag flags() const;
 
+  /// Get the order in which voxels are stored in each region's layer memory. This is selected on construction using
+  /// @c MapFlag::kVoxelOrderMorton or @c MapFlag::kVoxelOrderBrick4 and defaults to @c VoxelOrder::kRowMajor .
+  ///
+  /// Layers with dimensions which do not support this order use @c VoxelOrder::kRowMajor instead - see
+  /// @c resolveVoxelOrder() and @c layerVoxelOrder() .
+  /// @return The map voxel order.
+  VoxelOrder voxelOrder() const;
+
+  /// Get the voxel order used by the layer at @p layer_index . This is the @c voxelOrder() resolved for the layer
+  /// dimensions.
+  /// @param layer_index The index of the layer of interest.
+  /// @return The layer voxel order.
+  VoxelOrder layerVoxelOrder(int layer_index) const;
+
   //-------------------------------------------------------
   // Region management.
   //-------------------------------------------------------
@@ -478,6 +676,14 @@ public:
   /// @return True if the "incident_normal" layer is enabled.
   bool incidentNormalEnabled() const;
 
+  /// Add the "touch_incident" layer to the map. See @c addTouchIncident() . Does nothing if the layer is already
+  /// present.
+  void addTouchIncidentLayer();
+
+  /// Check if the "touch_incident" layer exists.
+  /// @return True if the "touch_incident" layer is enabled.
+  bool touchIncidentEnabled() const;
+
   /// Ensure a voxel layer called @p layer_name is present, invoking @p add_layer_function to add it if necessary.
   ///
   /// If the layer is not present, then a copy of the @c MapLayout is first made and modified by calling
@@ -495,8 +701,9 @@ public:
   /// the @p layout() after construction.
   ///
   /// By default this will attempt to preserve all voxel layers which are equivalent between the two layouts (see
-  /// @c MapLayer::checkEquivalent() ). Voxel layers not present in the new layer are destroyed, while new voxel
-  /// layers are allocated. This may take some time to process.
+  /// @c MapLayer::checkEquivalent() ). Preserved voxel layers are moved to the new layout without copying. Voxel layers
+  /// not present in the new layout are destroyed, while new voxel layers are left uninitialised until first accessed -
+  /// see @c VoxelBlock::kFUniform . Chunks are migrated in parallel when built with @c OHM_FEATURE_THREADS .
   ///
   /// This behaviour may be modified, by setting @c preserve_map to @c false , in which case this call destroys the
   /// current map content.
@@ -538,6 +745,124 @@ public:
   /// @return The number of removed regions.
   unsigned cullRegionsOutside(const glm::dvec3 &min_extents, const glm::dvec3 &max_extents);
 
+  /// Create and initialise all regions overlapping @p extents ahead of ray integration.
+  ///
+  /// Regions are otherwise created lazily by @c region() from within the ray integration, where initialising the
+  /// voxel layers of new regions shows up as latency spikes whenever the sensor enters unmapped space. Regions which
+  /// already exist are unaffected. Paged out or indexed regions are paged in. Voxel memory is allocated from the
+  /// @c voxelMemoryPool() , except for @c MapFlag::kUniformBlocks maps which defer allocation until first written.
+  ///
+  /// This is thread safe with respect to concurrent @c region() calls, so may be called from a background thread -
+  /// see @c RegionPreallocator .
+  ///
+  /// @param extents The box to preallocate regions for (global coordinates).
+  /// @return The number of regions which were not already in memory.
+  size_t preallocateRegions(const Aabb &extents);
+
+  /// Create and initialise all regions within @p radius of a planned @p path . See @c preallocateRegions() .
+  ///
+  /// Regions are selected conservatively: a region is preallocated if its bounding sphere is within @p radius of any
+  /// path segment.
+  ///
+  /// @param path The path points (global coordinates). A single point preallocates the regions around that point.
+  /// @param radius The distance from the path to preallocate regions for. Generally the sensor range.
+  /// @return The number of regions which were not already in memory.
+  size_t preallocateAlongPath(const std::vector<glm::dvec3> &path, double radius);
+
+  /// Enable paging regions out of memory to the given @p backing_file .
+  ///
+  /// Once enabled, @c updateRegionPaging() pages out the least recently used regions whenever the uncompressed
+  /// memory of the resident regions exceeds the @p resident_budget . Paged out regions are paged back in on demand by
+  /// @c region() . Note that paged out regions are not visited when iterating the map and are not affected by region
+  /// culling functions such as @c expireRegions() . Paged out regions are paged back in to save or clone the map.
+  ///
+  /// The CPU @c RayMapper implementations call @c updateRegionPaging() before integrating rays, using the sensor
+  /// position as the hot spot.
+  ///
+  /// @param backing_file Path to the backing file to create. The file is removed when paging is disabled.
+  /// @param resident_budget The budget for resident regions (bytes). Based on uncompressed region memory.
+  /// @param hot_radius Regions with centres within this distance of the hot spot are never paged out.
+  /// @return True on success, false if the backing file cannot be created.
+  bool enableRegionPaging(const std::string &backing_file, uint64_t resident_budget, double hot_radius = 0);
+
+  /// Disable region paging, paging in all regions and removing the backing file.
+  void disableRegionPaging();
+
+  /// Query if region paging is enabled.
+  /// @return True if region paging is enabled.
+  bool regionPagingEnabled() const;
+
+  /// Query the region paging budget. Zero when paging is disabled.
+  /// @return The resident region budget (bytes).
+  uint64_t regionPagingBudget() const;
+
+  /// Set the region paging budget. Ignored when paging is disabled.
+  /// @param resident_budget The budget for resident regions (bytes).
+  void setRegionPagingBudget(uint64_t resident_budget);
+
+  /// Query the number of regions currently paged out of memory.
+  /// @return The paged out region count.
+  size_t pagedOutRegionCount() const;
+
+  /// Page out the least recently used regions if over the region paging budget. Regions are paged out until the
+  /// resident memory is back under 90% of the budget, excluding regions within the hot radius of @p hot_spot .
+  /// Recency is tracked per call to this function, with regions further from @p hot_spot paged out first of those
+  /// equally recently used.
+  ///
+  /// This is not thread safe and must not be called while other threads are accessing the map. Any @c MapChunk
+  /// pointers or @c Voxel references to paged out regions are invalidated.
+  ///
+  /// @param hot_spot The reference position - generally the sensor position.
+  /// @return The number of regions paged out.
+  unsigned updateRegionPaging(const glm::dvec3 &hot_spot);
+
+  /// Enable the rolling window (robot centric) map mode, maintaining a fixed box of regions around a moving centre.
+  ///
+  /// The window covers @p region_dimensions regions centred on the region containing @p centre . Regions within the
+  /// window are tracked in a ring buffer indexed by region key. When @c moveRollingWindow() moves the window, regions
+  /// which leave it are removed from the map and their memory is kept for recycling. A region entering the window
+  /// reuses the memory of the region which left from the same ring buffer slot and is cleared in place without
+  /// allocation. This replaces calling @c removeDistanceRegions() or @c cullRegionsOutside() each update.
+  ///
+  /// Regions may still be created outside the window, such as by long rays. Such regions are removed on the next
+  /// window move. Existing regions outside the window are removed by this call.
+  ///
+  /// The rolling window is not intended for use with region paging or maps opened via @c ohm::openIndexed() .
+  ///
+  /// @param region_dimensions The window dimensions in regions. Each axis is clamped to be at least 1.
+  /// @param centre The initial window centre (global coordinates).
+  /// @return The number of regions removed.
+  unsigned enableRollingWindow(const glm::ivec3 &region_dimensions, const glm::dvec3 &centre);
+
+  /// Disable the rolling window map mode, releasing any memory held for recycling. Map regions are unchanged.
+  void disableRollingWindow();
+
+  /// Query if the rolling window map mode is enabled.
+  /// @return True if the rolling window is enabled.
+  bool rollingWindowEnabled() const;
+
+  /// Query the rolling window dimensions in regions. Zero when the rolling window is disabled.
+  /// @return The rolling window dimensions.
+  glm::ivec3 rollingWindowDimensions() const;
+
+  /// Query the region key range covered by the rolling window.
+  /// @param[out] min_key Set to the minimum region key in the window.
+  /// @param[out] max_key Set to the maximum region key in the window (inclusive).
+  /// @return True if the rolling window is enabled and the keys are set.
+  bool rollingWindowKeys(glm::i16vec3 *min_key, glm::i16vec3 *max_key) const;
+
+  /// Move the rolling window to be centred on the region containing @p centre , removing regions which leave the
+  /// window and regions created outside the window since the last move. Removed region memory is retained for
+  /// recycling by regions entering the window. The cost of this call is proportional to the window volume,
+  /// independent of the number of regions in the map, and no hash map iteration is performed.
+  ///
+  /// This must not be called concurrently with other threads accessing the map. Any @c MapChunk pointers or
+  /// @c Voxel references to removed regions are invalidated.
+  ///
+  /// @param centre The window centre (global coordinates). Generally the sensor position.
+  /// @return The number of regions removed. Zero if the rolling window is disabled.
+  unsigned moveRollingWindow(const glm::dvec3 &centre);
+
   /// Touch the @c MapRegion which contains @p point .
   /// @param point A spatial point from which to resolve a containing region. There may be border case issues.
   /// @param timestamp The timestamp to update the region touch time to.
@@ -665,6 +990,8 @@ public:
   /// Setting a value less than 0.5 is not recommended as this can include "miss" results integrated
   /// into the map.
   ///
+  /// Changing the threshold marks the occupancy state layer stale - see @c occupancyStateStale() .
+  ///
   /// @param probability The new occupancy threshold [0, 1].
   void setOccupancyThresholdProbability(float probability);
 
@@ -722,6 +1049,23 @@ public:
   /// @param saturate True to have voxels prevent further value adjustments at the minimum value.
   void setSaturateAtMaxValue(bool saturate);
 
+  /// Query the time constant for the lazy, time based decay of observed occupancy values. Zero when disabled.
+  /// @return The occupancy decay time constant (seconds).
+  double occupancyDecayTime() const;
+
+  /// Set the time constant for the lazy decay of observed occupancy values towards the uncertain, 0.5 probability
+  /// prior. Decay requires the touch time layer - see @c addTouchTimeLayer() - and timestamped rays.
+  ///
+  /// Decay is evaluated per voxel when it is accessed rather than as a map wide pass. Before each update,
+  /// @c RayMapperOccupancy scales the voxel log odds value by `exp(-dt / decay_time)` where @c dt is the time since
+  /// the voxel touch time, then records the update time as the new touch time. Queries may read decayed values with
+  /// @c decayedOccupancy() . Voxels locked at a saturation limit do not decay. Regions which have fully decayed may be
+  /// removed in the background by a @c RegionCullProcess - see @c RegionCullProcess::setDecayCullTime() .
+  ///
+  /// The setting is not serialised.
+  /// @param decay_time The decay time constant (seconds). Zero or negative to disable.
+  void setOccupancyDecayTime(double decay_time);
+
   //-------------------------------------------------------
   // General map manipulation.
   //-------------------------------------------------------
@@ -793,6 +1137,17 @@ public:
   /// @overload
   Key voxelKey(const glm::vec3 &point) const;
 
+  /// Convert an array of global coordinates to voxel keys. Equivalent to calling @c voxelKey() for each point, with
+  /// identical results, but faster for large point sets.
+  ///
+  /// Quantisation uses precomputed reciprocals of the region and voxel sizes rather than division. Points which fall
+  /// close enough to a region or voxel boundary for the reciprocal to change the result fall back to @c voxelKey() .
+  ///
+  /// @param points The global coordinates to convert.
+  /// @param count The number of @p points .
+  /// @param[out] keys Array of at least @p count elements to receive the key for each point.
+  void voxelKeys(const glm::dvec3 *points, size_t count, Key *keys) const;
+
   /// Convert a local coordinate to the key value for the containing voxel.
   /// @param local_point A map local coordinate (relative to @c origin()) to convert.
   /// @return The @c Key for the voxel containing @p localPoint.
@@ -902,6 +1257,8 @@ public:
 
   /// Set the range filter applied to all rays to be integrated into the map. @c RayMapper implementations must
   /// respect this filter in @c RayMapper::integrateRays() .
+  ///
+  /// This also clears the @c rayBatchFilter() so that the new filter is used by all mappers.
   /// @param ray_filter The range filter to install and filter rays with. Accepts an empty, which clears the filter.
   void setRayFilter(const RayFilterFunction &ray_filter);
 
@@ -911,7 +1268,19 @@ public:
   /// @return The current ray filter.
   const RayFilterFunction &rayFilter() const;
 
-  /// Clears the @c rayFilter().
+  /// Set the batch ray filter. Mappers which support batch filtering - @c RayMapperOccupancy and @c GpuMap - apply
+  /// this filter to each ray array as a separate pass in preference to the @c rayFilter() . Other mappers continue to
+  /// use the @c rayFilter() , so the two filters should be equivalent.
+  ///
+  /// The map starts with a @c goodRayBatchFilter() equivalent to the default @c rayFilter() .
+  /// @param ray_batch_filter The batch filter to install. Accepts an empty function, which clears the filter.
+  void setRayBatchFilter(const RayBatchFilterFunction &ray_batch_filter);
+
+  /// Get the batch ray filter. See @c setRayBatchFilter() .
+  /// @return The current batch ray filter.
+  const RayBatchFilterFunction &rayBatchFilter() const;
+
+  /// Clears the @c rayFilter() and the @c rayBatchFilter() .
   void clearRayFilter();
 
   /// Integrate the given @p rays into the map. The @p rays form a list of origin/sample pairs for which
@@ -934,13 +1303,19 @@ public:
   //-------------------------------------------------------
 
   /// Clone the entire map.
+  ///
+  /// Compressed voxel blocks are not uncompressed. Their compressed data are shared between the maps and each map
+  /// makes its own uncompressed copy on access - see @c VoxelBlock::copyFrom() . Region copies are made in parallel
+  /// when built with @c OHM_FEATURE_THREADS .
+  ///
   /// @return A deep clone of this map. Caller takes ownership.
   OccupancyMap *clone() const;
 
   /// Clone the map within the given extents.
   ///
   /// This creates a deep clone of this may, copying only regions which overlap the given extents.
-  /// Note that any region which partially overmaps the extents is copied in its entirety.
+  /// Note that any region which partially overmaps the extents is copied in its entirety. Voxel data are copied as
+  /// for @c clone() .
   ///
   /// @param min_ext The minimum spatial extents to over.
   /// @param max_ext The maximum spatial extents to over.
@@ -959,10 +1334,23 @@ public:
   inline const OccupancyMapDetail *detail() const { return imp_; }
 
   /// Enumerate the regions within this map.
+  ///
+  /// This is thread safe with respect to concurrent @c region() calls, but regions created during enumeration may or
+  /// may not be included.
+  ///
   /// @param[out] chunks The enumerated chunks are added to this container.
   void enumerateRegions(std::vector<const MapChunk *> &chunks) const;
 
   /// Fetch a region, potentially creating it. For internal use.
+  ///
+  /// Region lookup is lock-free and region creation is thread safe; concurrent calls creating the same region yield
+  /// the same @c MapChunk . The returned chunk remains valid until the region is removed - e.g., by @c cullRegions()
+  /// or @c clear() .
+  ///
+  /// For a map opened via @c ohm::openIndexed() , a region present in the file is loaded from the file on first
+  /// access. Similarly, regions paged out by @c updateRegionPaging() are paged back in. Concurrent requests for the
+  /// same region load it once.
+  ///
   /// @param region_key The key of the region to fetch.
   /// @param allow_create Create the region if it doesn't exist?
   /// @return A pointer to the requested region. Null if it doesn't exist and @p allowCreate is @c false.
@@ -971,6 +1359,42 @@ public:
   /// @overload
   const MapChunk *region(const glm::i16vec3 &region_key) const;
 
+  /// Load all regions not yet paged in from the file opened via @c ohm::openIndexed() , then release the file. This
+  /// also pages in any regions paged out by @c updateRegionPaging() .
+  ///
+  /// Regions of an indexed map are otherwise loaded on demand by @c region() and iteration only visits regions already
+  /// loaded. This is a no-op if the map was not opened from an indexed map file and no regions are paged out.
+  ///
+  /// This is not thread safe with respect to concurrent @c region() calls.
+  void pageInAllRegions() const;
+
+  /// Enumerate the keys of the regions stored in the file opened via @c ohm::openIndexed() , whether or not they have
+  /// been paged in.
+  ///
+  /// This supports visiting an indexed map in bounded memory by fetching a subset of the regions at a time - see
+  /// @c parallelFetchRegions() - then evicting them with @c detachRegions() once processed. Evicted regions are not
+  /// paged in again.
+  ///
+  /// @param[out] region_keys The region keys are added to this container in file order.
+  /// @return The number of keys added. Zero when the map was not opened from an indexed map file or after
+  ///   @c pageInAllRegions() .
+  size_t enumerateIndexedRegions(std::vector<glm::i16vec3> &region_keys) const;
+
+  /// Remove the regions at @p region_keys from the map without releasing their memory, supporting deferred deletion.
+  ///
+  /// Each removal is a constant time operation and is safe to call concurrently with @c region() lookups of other
+  /// regions. The detached chunks are appended to @p detached and must later be released by @c releaseRegions() ,
+  /// once no other thread may still reference them. See @c RegionCullProcess .
+  ///
+  /// @param region_keys The keys of the regions to remove. Keys not present in the map are ignored.
+  /// @param[out] detached The detached chunks are added to this container.
+  /// @return The number of regions removed.
+  unsigned detachRegions(const std::vector<glm::i16vec3> &region_keys, std::vector<MapChunk *> &detached);
+
+  /// Release chunks detached by @c detachRegions() . This does not access the map and may be called from any thread.
+  /// @param chunks The chunks to release. Cleared on return.
+  static void releaseRegions(std::vector<MapChunk *> &chunks);
+
   /// Populate @c regions with a list of regions who's touch stamp is greater than the given value.
   ///
   /// Adds to @p regions without clearing it, thus there may be redundancy.
@@ -998,12 +1422,45 @@ public:
 private:
   Key firstIterationKey() const;
   MapChunk *newChunk(const Key &for_key);
+
+  /// Ensure the region at @p region_key is in memory, creating it if required.
+  /// @param region_key The key of the region to preallocate.
+  /// @return True if the region was not already in memory.
+  bool preallocateRegion(const glm::i16vec3 &region_key);
   static void releaseChunk(const MapChunk *chunk);
 
+  /// Load the region at @p region_key from the @c OccupancyMapDetail::indexed_file . Must only be called when the
+  /// indexed file is present.
+  /// @param region_key The key of the region to load.
+  /// @return The loaded chunk, or null if @p region_key is not present in the file or fails to load.
+  MapChunk *pageInRegion(const glm::i16vec3 &region_key) const;
+
+  /// Page in the region at @p region_key from the @c OccupancyMapDetail::pager . Must only be called when paging is
+  /// enabled.
+  /// @param region_key The key of the region to load.
+  /// @param[out] paged_out Set to true if the region was paged out, even if paging in fails.
+  /// @return The paged in chunk, the existing chunk if paged in by another thread, or null if not found or the region
+  ///   fails to load.
+  MapChunk *pageInPagedRegion(const glm::i16vec3 &region_key, bool &paged_out) const;
+
+  /// Create the region at @p region_key in rolling window mode, recycling a spare chunk from the window slot where
+  /// possible. Must only be called when the rolling window is enabled.
+  /// @param region_key The key of the region to create.
+  /// @return The created chunk, or the existing chunk if created by another thread.
+  MapChunk *newWindowRegion(const glm::i16vec3 &region_key);
+
+  /// Remove the region at @p region_key from the map and the GPU cache without releasing it.
+  /// @param region_key The key of the region to remove.
+  /// @return The removed chunk, or null if not present. The caller takes ownership.
+  MapChunk *detachRegion(const glm::i16vec3 &region_key);
+
   /// Culling function for @c cullRegions().
   using RegionCullFunc = std::function<bool(const MapChunk &)>;
 
   /// Remove regions/chunks for which @c cull_func returns true.
+  ///
+  /// Safe to call concurrently with @c region() lookups of other regions. Culled chunks are released immediately.
+  ///
   /// @param cull_func The culling criteria.
   /// @return The number of regions removed.
   unsigned cullRegions(const RegionCullFunc &cull_func);
@@ -0,0 +1,181 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OccupancyState.h"
+
+#include "DefaultLayer.h"
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "Voxel.h"
+#include "VoxelSpan.h"
+
+#include <ohmutil/Profile.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace ohm
+{
+namespace
+{
+/// Count the free and occupied voxels in @p chunk from the occupancy layer.
+std::pair<size_t, size_t> countOccupancyValues(const OccupancyMap &map, const MapChunk &chunk, int occupancy_layer)
+{
+  std::pair<size_t, size_t> counts(0u, 0u);
+  const float threshold_value = map.occupancyThresholdValue();
+  const VoxelSpan<const float> occupancy(&chunk, map, occupancy_layer);
+  for (const float value : occupancy)
+  {
+    const unsigned state = occupancyStateFromValue(value, threshold_value);
+    counts.first += (state == kOsFree) ? 1u : 0u;
+    counts.second += (state == kOsOccupied) ? 1u : 0u;
+  }
+  return counts;
+}
+}  // namespace
+
+
+bool occupancyStateStale(const MapChunk &chunk, int occupancy_layer, int state_layer)
+{
+  return chunk.touched_stamps[state_layer].load(std::memory_order_relaxed) <
+         chunk.layerTouchedStamp(unsigned(occupancy_layer));
+}
+
+
+OccupancyType occupancyState(const OccupancyMap &map, const Key &key)
+{
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int state_layer = map.layout().layerIndex(default_layer::occupancyStateLayerName());
+  const Voxel<const uint16_t> state(&map, state_layer, Key(key.regionKey(), key.localKey() / uint8_t(2)));
+  if (!state.isValid())
+  {
+    return kNull;
+  }
+
+  if (occupancy_layer >= 0 && occupancyStateStale(*state.chunk(), occupancy_layer, state_layer))
+  {
+    const Voxel<const float> occupancy(&map, occupancy_layer, key);
+    return occupancyType(occupancy);
+  }
+
+  switch (unpackOccupancyState(state.data(), key.localKey()))
+  {
+  case kOsFree:
+    return kFree;
+  case kOsOccupied:
+    return kOccupied;
+  default:
+    break;
+  }
+  return kUnobserved;
+}
+
+
+bool updateOccupancyState(OccupancyMap &map, bool use_threads)
+{
+  PROFILE(updateOccupancyState);
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+  if ((region_dim.x & 1u) || (region_dim.y & 1u) || (region_dim.z & 1u))
+  {
+    return false;
+  }
+
+  map.addLayer(default_layer::occupancyStateLayerName(), [](MapLayout &layout) { addOccupancyState(layout); });
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int state_layer = map.layout().layerIndex(default_layer::occupancyStateLayerName());
+  const float threshold_value = map.occupancyThresholdValue();
+  const uint64_t stamp = map.touch();
+
+  parallelForEachRegion(
+    map,
+    [&map, occupancy_layer, state_layer, threshold_value, stamp, region_dim](
+      const MapChunk &chunk, size_t /*region_index*/, unsigned /*worker_index*/)  //
+    {
+      if (occupancy_layer < 0 || !occupancyStateStale(chunk, occupancy_layer, state_layer))
+      {
+        return;
+      }
+
+      const VoxelSpan<const float> occupancy(&chunk, map, occupancy_layer);
+      // The map is mutable, so its chunks are too.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      VoxelSpan<uint16_t> state(const_cast<MapChunk *>(&chunk), map, state_layer);
+      if (!occupancy.isValid() || !state.isValid())
+      {
+        return;
+      }
+
+      std::fill(state.begin(), state.end(), uint16_t(0u));
+      const VoxelKeyDecoder &occupancy_keys = occupancy.keyDecoder();
+      const VoxelKeyDecoder &state_keys = state.keyDecoder();
+      glm::u8vec3 local_key(0);
+      for (local_key.z = 0; local_key.z < region_dim.z; ++local_key.z)
+      {
+        for (local_key.y = 0; local_key.y < region_dim.y; ++local_key.y)
+        {
+          for (local_key.x = 0; local_key.x < region_dim.x; ++local_key.x)
+          {
+            const float value = occupancy[occupancy_keys.index(local_key)];
+            const unsigned state_index = state_keys.index(local_key / uint8_t(2));
+            state[state_index] =
+              packOccupancyState(state[state_index], local_key, occupancyStateFromValue(value, threshold_value));
+          }
+        }
+      }
+
+      state.touch(stamp);
+    },
+    use_threads);
+
+  return true;
+}
+
+
+bool countOccupancyStates(const OccupancyMap &map, size_t *free_count, size_t *occupied_count, bool use_threads)
+{
+  PROFILE(countOccupancyStates);
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int state_layer = map.layout().layerIndex(default_layer::occupancyStateLayerName());
+  if (occupancy_layer < 0 || state_layer < 0)
+  {
+    return false;
+  }
+
+  using Counts = std::pair<size_t, size_t>;
+  const Counts counts = parallelReduceRegions(
+    map, Counts(0u, 0u),
+    [&map, occupancy_layer, state_layer](const MapChunk &chunk, unsigned /*worker_index*/)  //
+    {
+      if (occupancyStateStale(chunk, occupancy_layer, state_layer))
+      {
+        return countOccupancyValues(map, chunk, occupancy_layer);
+      }
+
+      Counts region_counts(0u, 0u);
+      const VoxelSpan<const uint16_t> state(&chunk, map, state_layer);
+      for (const uint16_t packed : state)
+      {
+        region_counts.first += popCount16(uint16_t(packed & kOccupancyStateFreeBits));
+        region_counts.second += popCount16(uint16_t(packed & kOccupancyStateOccupiedBits));
+      }
+      return region_counts;
+    },
+    [](const Counts &a, const Counts &b) { return Counts(a.first + b.first, a.second + b.second); }, use_threads);
+
+  if (free_count)
+  {
+    *free_count = counts.first;
+  }
+  if (occupied_count)
+  {
+    *occupied_count = counts.second;
+  }
+  return true;
+}
+}  // namespace ohm
@@ -0,0 +1,143 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_OCCUPANCYSTATE_H
+#define OHM_OCCUPANCYSTATE_H
+
+#include "OhmConfig.h"
+
+#include "OccupancyType.h"
+#include "VoxelOccupancy.h"
+
+#include <glm/vec3.hpp>
+
+#include <cinttypes>
+#include <cstddef>
+
+namespace ohm
+{
+/// @defgroup occupancystate Occupancy state layer
+/// The occupancy state layer is an optional, derived layer holding the occupancy tri-state of each voxel in two bits -
+/// see @c MapFlag::kOccupancyState and @c addOccupancyState() . Each @c uint16_t voxel of the subsampled layer packs
+/// the states of a 2x2x2 block of occupancy voxels, so queries which only need the voxel state may read 1/16th of the
+/// occupancy memory and use bitwise scans.
+///
+/// The @c RayMapperOccupancy and @c ClearingPattern maintain the state layer incrementally. Other updates to the
+/// occupancy layer, such as from a @c GpuMap , the NDT, TSDF or projective mappers, @c mergeMap() or direct @c Voxel
+/// writes, leave the state layer stale in the affected regions. A region is stale when its occupancy layer
+/// @c MapChunk::touched_stamps is newer than that of the state layer - see @c occupancyStateStale() .
+/// @c OccupancyMap::setOccupancyThresholdProbability() marks every region stale. @c occupancyState() and
+/// @c countOccupancyStates() fall back to the occupancy layer for stale regions, while @c updateOccupancyState()
+/// rebuilds them.
+
+/// @ingroup occupancystate
+/// Two bit voxel states stored in the occupancy state layer.
+enum OccupancyState : unsigned
+{
+  kOsUnobserved = 0u,  ///< Unobserved or uncertain voxel.
+  kOsFree = 1u,        ///< Observed free voxel.
+  kOsOccupied = 2u,    ///< Observed occupied voxel.
+  kOsMask = 3u         ///< Mask for a single voxel state.
+};
+
+/// @ingroup occupancystate
+/// Bit pattern selecting the low bit of every voxel state in a packed state voxel: set for @c kOsFree .
+constexpr uint16_t kOccupancyStateFreeBits = 0x5555u;
+/// @ingroup occupancystate
+/// Bit pattern selecting the high bit of every voxel state in a packed state voxel: set for @c kOsOccupied .
+constexpr uint16_t kOccupancyStateOccupiedBits = 0xAAAAu;
+
+/// @ingroup occupancystate
+/// Query the bit shift for the state of the voxel at @p local_key within its packed state voxel.
+/// @param local_key The voxel @c Key::localKey() .
+/// @return The bit shift [0, 16) in steps of 2.
+inline unsigned occupancyStateShift(const glm::u8vec3 &local_key)
+{
+  return 2u * (unsigned(local_key.x & 1u) | (unsigned(local_key.y & 1u) << 1u) | (unsigned(local_key.z & 1u) << 2u));
+}
+
+/// @ingroup occupancystate
+/// Convert an occupancy value into an @c OccupancyState .
+/// @param value The occupancy value.
+/// @param occupancy_threshold_value The occupancy threshold - see @c OccupancyMap::occupancyThresholdValue() .
+/// @return The state for @p value .
+inline unsigned occupancyStateFromValue(float value, float occupancy_threshold_value)
+{
+  return (value == unobservedOccupancyValue()) ? kOsUnobserved :
+                                                 ((value >= occupancy_threshold_value) ? kOsOccupied : kOsFree);
+}
+
+/// @ingroup occupancystate
+/// Set the @p state for the voxel at @p local_key in a @p packed state voxel.
+/// @param packed The packed state voxel value.
+/// @param local_key The voxel @c Key::localKey() .
+/// @param state The new @c OccupancyState .
+/// @return The modified packed value.
+inline uint16_t packOccupancyState(uint16_t packed, const glm::u8vec3 &local_key, unsigned state)
+{
+  const unsigned shift = occupancyStateShift(local_key);
+  return uint16_t((packed & ~(kOsMask << shift)) | ((state & kOsMask) << shift));
+}
+
+/// @ingroup occupancystate
+/// Extract the state for the voxel at @p local_key from a @p packed state voxel.
+/// @param packed The packed state voxel value.
+/// @param local_key The voxel @c Key::localKey() .
+/// @return The @c OccupancyState .
+inline unsigned unpackOccupancyState(uint16_t packed, const glm::u8vec3 &local_key)
+{
+  return (packed >> occupancyStateShift(local_key)) & kOsMask;
+}
+
+/// @ingroup occupancystate
+/// Count the set bits in @p bits .
+/// @param bits The value to count.
+/// @return The number of set bits.
+inline unsigned popCount16(uint16_t bits)
+{
+  unsigned value = bits;
+  value = value - ((value >> 1u) & 0x5555u);
+  value = (value & 0x3333u) + ((value >> 2u) & 0x3333u);
+  value = (value + (value >> 4u)) & 0x0F0Fu;
+  return (value + (value >> 8u)) & 0x1Fu;
+}
+
+/// @ingroup occupancystate
+/// Check if the occupancy state layer of @p chunk is out of date with respect to its occupancy layer.
+/// @param chunk The region to check.
+/// @param occupancy_layer The occupancy layer index - see @c MapLayout::occupancyLayer() .
+/// @param state_layer The occupancy state layer index.
+/// @return True if the occupancy layer has been touched since the state layer was last updated.
+bool ohm_API occupancyStateStale(const MapChunk &chunk, int occupancy_layer, int state_layer);
+
+/// @ingroup occupancystate
+/// Query the @c OccupancyType of the voxel at @p key from the occupancy state layer. The occupancy layer is read
+/// instead when the state layer is stale for the region.
+/// @param map The map to query.
+/// @param key The voxel of interest.
+/// @return The voxel type, or @c kNull if the state layer or region do not exist.
+OccupancyType ohm_API occupancyState(const OccupancyMap &map, const Key &key);
+
+/// @ingroup occupancystate
+/// Rebuild the occupancy state layer from the occupancy layer in each region where it is stale. The layer is added
+/// if not present.
+/// @param map The map to update.
+/// @param use_threads Allow regions to be processed in parallel?
+/// @return False if the region voxel dimensions are not even, in which case the map is unchanged.
+bool ohm_API updateOccupancyState(OccupancyMap &map, bool use_threads = true);
+
+/// @ingroup occupancystate
+/// Count the free and occupied voxels in @p map using the occupancy state layer. The occupancy layer is counted
+/// instead for regions where the state layer is stale.
+/// @param map The map to query.
+/// @param[out] free_count Set to the number of free voxels.
+/// @param[out] occupied_count Set to the number of occupied voxels.
+/// @param use_threads Allow regions to be processed in parallel?
+/// @return False if the map has no occupancy state layer.
+bool ohm_API countOccupancyStates(const OccupancyMap &map, size_t *free_count, size_t *occupied_count,
+                                  bool use_threads = true);
+}  // namespace ohm
+
+#endif  // OHM_OCCUPANCYSTATE_H
@@ -0,0 +1,196 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OccupancySummary.h"
+
+#include "MapChunk.h"
+#include "OccupancyMap.h"
+#include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrder.h"
+
+#include "private/OccupancyMapDetail.h"
+
+#include <algorithm>
+
+namespace ohm
+{
+void OccupancyBrick::add(float occupancy)
+{
+  if (occupancy == unobservedOccupancyValue())
+  {
+    flags = uint8_t(flags | kUnobserved);
+    return;
+  }
+
+  min_occupancy = std::min(occupancy, min_occupancy);
+  max_occupancy = std::max(occupancy, max_occupancy);
+  flags = uint8_t(flags | kObserved);
+}
+
+
+void RegionOccupancySummary::build(const MapChunk &chunk)
+{
+  const OccupancyMapDetail &map = *chunk.map;
+  layer_index_ = map.layout.occupancyLayer();
+  region_dimensions_ = glm::ivec3(map.region_voxel_dimensions);
+  // Capture the stamp before reading the voxels so we err on the side of rebuilding on concurrent modification.
+  stamp_ = (layer_index_ >= 0) ? chunk.touched_stamps[layer_index_].load(std::memory_order_relaxed) : 0u;
+
+  // Size the levels, doubling the brick size until a single brick covers the region.
+  const int max_dimension = std::max(region_dimensions_.x, std::max(region_dimensions_.y, region_dimensions_.z));
+  levels_.clear();
+  level_dimensions_.clear();
+  for (int brick_size = kMinBrickSize;; brick_size *= 2)
+  {
+    const glm::ivec3 dim = (region_dimensions_ + glm::ivec3(brick_size - 1)) / brick_size;
+    level_dimensions_.emplace_back(dim);
+    levels_.emplace_back(size_t(dim.x) * size_t(dim.y) * size_t(dim.z));
+    if (brick_size >= max_dimension)
+    {
+      break;
+    }
+  }
+
+  if (layer_index_ < 0)
+  {
+    return;
+  }
+
+  // Build the base level from the voxels.
+  VoxelBuffer<const VoxelBlock> occupancy_buffer(chunk.voxel_blocks[layer_index_]);
+  const VoxelOrder order = resolveVoxelOrder(voxelOrderFromFlags(map.flags), region_dimensions_);
+  std::vector<OccupancyBrick> &base = levels_.front();
+  const glm::ivec3 &base_dim = level_dimensions_.front();
+  glm::ivec3 local_key;
+  for (local_key.z = 0; local_key.z < region_dimensions_.z; ++local_key.z)
+  {
+    for (local_key.y = 0; local_key.y < region_dimensions_.y; ++local_key.y)
+    {
+      for (local_key.x = 0; local_key.x < region_dimensions_.x; ++local_key.x)
+      {
+        float occupancy = unobservedOccupancyValue();
+        occupancy_buffer.readVoxel(voxelIndex(glm::u8vec3(local_key), region_dimensions_, order), &occupancy);
+        const glm::ivec3 brick_coord = local_key / kMinBrickSize;
+        base[brick_coord.x + brick_coord.y * base_dim.x + brick_coord.z * base_dim.x * base_dim.y].add(occupancy);
+      }
+    }
+  }
+
+  // Build each subsequent level from the preceding one.
+  for (size_t level = 1; level < levels_.size(); ++level)
+  {
+    const std::vector<OccupancyBrick> &children = levels_[level - 1];
+    const glm::ivec3 &child_dim = level_dimensions_[level - 1];
+    std::vector<OccupancyBrick> &parents = levels_[level];
+    const glm::ivec3 &parent_dim = level_dimensions_[level];
+    glm::ivec3 child;
+    for (child.z = 0; child.z < child_dim.z; ++child.z)
+    {
+      for (child.y = 0; child.y < child_dim.y; ++child.y)
+      {
+        for (child.x = 0; child.x < child_dim.x; ++child.x)
+        {
+          const glm::ivec3 parent = child / 2;
+          parents[parent.x + parent.y * parent_dim.x + parent.z * parent_dim.x * parent_dim.y].merge(
+            children[child.x + child.y * child_dim.x + child.z * child_dim.x * child_dim.y]);
+        }
+      }
+    }
+  }
+}
+
+
+bool RegionOccupancySummary::isCurrent(const MapChunk &chunk) const
+{
+  const OccupancyMapDetail &map = *chunk.map;
+  return layer_index_ >= 0 && layer_index_ == map.layout.occupancyLayer() &&
+         region_dimensions_ == glm::ivec3(map.region_voxel_dimensions) &&
+         stamp_ == chunk.touched_stamps[layer_index_].load(std::memory_order_relaxed);
+}
+
+
+int RegionOccupancySummary::emptyRunLength(const glm::ivec3 &local_key, float occupancy_threshold,
+                                           bool unobserved_as_occupied) const
+{
+  // Check the smallest brick first as this is the common failure case in occupied space.
+  if (brickContaining(0, local_key).mayContainOccupied(occupancy_threshold, unobserved_as_occupied))
+  {
+    return 0;
+  }
+
+  // Expand to the largest empty brick.
+  unsigned level = 0;
+  while (level + 1 < levelCount() &&
+         !brickContaining(level + 1, local_key).mayContainOccupied(occupancy_threshold, unobserved_as_occupied))
+  {
+    ++level;
+  }
+
+  const int brick_size = brickSize(level);
+  const int brick_end = std::min((local_key.x / brick_size + 1) * brick_size, region_dimensions_.x);
+  return brick_end - local_key.x;
+}
+
+
+const RegionOccupancySummary *updateOccupancySummary(MapChunk &chunk)
+{
+  if (!chunk.map || (chunk.map->flags & MapFlag::kOccupancySummary) == MapFlag::kNone ||
+      chunk.map->layout.occupancyLayer() < 0)
+  {
+    return nullptr;
+  }
+
+  if (!chunk.occupancy_summary)
+  {
+    chunk.occupancy_summary = std::make_unique<RegionOccupancySummary>();
+  }
+
+  if (!chunk.occupancy_summary->isCurrent(chunk))
+  {
+    chunk.occupancy_summary->build(chunk);
+  }
+
+  return chunk.occupancy_summary.get();
+}
+
+
+const RegionOccupancySummary *currentOccupancySummary(const MapChunk &chunk)
+{
+  if (chunk.occupancy_summary && chunk.occupancy_summary->isCurrent(chunk))
+  {
+    return chunk.occupancy_summary.get();
+  }
+  return nullptr;
+}
+
+
+void updateOccupancySummaries(OccupancyMap &map, const glm::dvec3 &min_ext, const glm::dvec3 &max_ext)
+{
+  if ((map.flags() & MapFlag::kOccupancySummary) == MapFlag::kNone)
+  {
+    return;
+  }
+
+  const glm::i16vec3 min_region = map.regionKey(min_ext);
+  const glm::i16vec3 max_region = map.regionKey(max_ext);
+  glm::i16vec3 region_key;
+  for (int z = min_region.z; z <= max_region.z; ++z)
+  {
+    for (int y = min_region.y; y <= max_region.y; ++y)
+    {
+      for (int x = min_region.x; x <= max_region.x; ++x)
+      {
+        region_key = glm::i16vec3(x, y, z);
+        MapChunk *chunk = map.region(region_key, false);
+        if (chunk)
+        {
+          updateOccupancySummary(*chunk);
+        }
+      }
+    }
+  }
+}
+}  // namespace ohm
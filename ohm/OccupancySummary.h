@@ -0,0 +1,186 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_OCCUPANCYSUMMARY_H
+#define OHM_OCCUPANCYSUMMARY_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct MapChunk;
+
+/// Summary of the occupancy values within a cubic brick of voxels in a @c RegionOccupancySummary .
+struct ohm_API OccupancyBrick
+{
+  /// Values for @c flags .
+  enum Flag : uint8_t
+  {
+    /// The brick contains at least one observed voxel.
+    kObserved = (1u << 0u),
+    /// The brick contains at least one unobserved voxel.
+    kUnobserved = (1u << 1u)
+  };
+
+  /// Minimum occupancy value of the observed voxels in the brick. Infinite when there are no observed voxels.
+  float min_occupancy = std::numeric_limits<float>::infinity();
+  /// Maximum occupancy value of the observed voxels in the brick. Negative infinity when there are no observed voxels.
+  float max_occupancy = -std::numeric_limits<float>::infinity();
+  /// @c Flag values.
+  uint8_t flags = 0;
+
+  /// Query if the brick may contain a voxel which is considered occupied. Voxels are occupied when their value is at
+  /// or above @p occupancy_threshold , or for unobserved voxels when @p unobserved_as_occupied is set.
+  /// @param occupancy_threshold The occupancy threshold value - see @c OccupancyMap::occupancyThresholdValue() .
+  /// @param unobserved_as_occupied Treat unobserved voxels as occupied?
+  /// @return False if the brick definitely contains no occupied voxels.
+  inline bool mayContainOccupied(float occupancy_threshold, bool unobserved_as_occupied) const
+  {
+    return max_occupancy >= occupancy_threshold || (unobserved_as_occupied && (flags & kUnobserved));
+  }
+
+  /// Query if every voxel in the brick is unobserved.
+  /// @return True when there are no observed voxels in the brick.
+  inline bool isUnobserved() const { return !(flags & kObserved); }
+
+  /// Add a voxel @p occupancy value to the brick.
+  /// @param occupancy The voxel occupancy value.
+  void add(float occupancy);
+
+  /// Merge @p other into this brick.
+  /// @param other The brick to merge.
+  inline void merge(const OccupancyBrick &other)
+  {
+    min_occupancy = (other.min_occupancy < min_occupancy) ? other.min_occupancy : min_occupancy;
+    max_occupancy = (other.max_occupancy > max_occupancy) ? other.max_occupancy : max_occupancy;
+    flags = uint8_t(flags | other.flags);
+  }
+};
+
+/// A hierarchical summary of the occupancy layer of a @c MapChunk .
+///
+/// The summary is a pyramid of @c OccupancyBrick levels. Level zero summarises cubic bricks of @c kMinBrickSize
+/// voxels per edge, with each subsequent level doubling the brick size until a single brick covers the region. Queries
+/// use the summary to skip bricks which cannot contain occupied voxels, rather than examining each voxel.
+///
+/// Summaries are maintained for maps created with @c MapFlag::kOccupancySummary . A summary is owned by its
+/// @c MapChunk and lazily rebuilt by @c updateOccupancySummary() when the @c MapChunk::touched_stamps for the occupancy
+/// layer show the region has been modified since the last build. Only modified regions are rebuilt.
+class ohm_API RegionOccupancySummary
+{
+public:
+  /// Edge length of the bricks in level zero of the summary.
+  static constexpr int kMinBrickSize = 4;
+
+  /// (Re)build the summary from the occupancy layer of @p chunk .
+  /// @param chunk The chunk to summarise.
+  void build(const MapChunk &chunk);
+
+  /// Query if the summary is up to date with the occupancy layer of @p chunk .
+  /// @param chunk The chunk of interest. Must be the chunk which owns this summary.
+  /// @return True if the summary is current.
+  bool isCurrent(const MapChunk &chunk) const;
+
+  /// Query the @c MapChunk::touched_stamps value for the occupancy layer when the summary was built.
+  /// @return The summary stamp.
+  inline uint64_t stamp() const { return stamp_; }
+
+  /// Query the number of levels in the summary pyramid.
+  /// @return The number of levels.
+  inline unsigned levelCount() const { return unsigned(levels_.size()); }
+
+  /// Query the voxel edge length of the bricks at @p level .
+  /// @param level The level of interest.
+  /// @return The brick size in voxels.
+  inline int brickSize(unsigned level) const { return kMinBrickSize << level; }
+
+  /// Query the number of bricks along each axis at @p level .
+  /// @param level The level of interest. Must be less than @c levelCount() .
+  /// @return The brick dimensions for @p level .
+  inline const glm::ivec3 &levelDimensions(unsigned level) const { return level_dimensions_[level]; }
+
+  /// Access the brick at @p brick_coord in @p level .
+  /// @param level The level of interest. Must be less than @c levelCount() .
+  /// @param brick_coord The brick coordinate. Must be in the range of @c levelDimensions() .
+  /// @return The brick summary.
+  inline const OccupancyBrick &brick(unsigned level, const glm::ivec3 &brick_coord) const
+  {
+    const glm::ivec3 &dim = level_dimensions_[level];
+    return levels_[level][brick_coord.x + brick_coord.y * dim.x + brick_coord.z * dim.x * dim.y];
+  }
+
+  /// Access the brick in @p level which contains the voxel at @p local_key .
+  /// @param level The level of interest. Must be less than @c levelCount() .
+  /// @param local_key The local voxel coordinate within the region - see @c Key::localKey() .
+  /// @return The brick summary.
+  inline const OccupancyBrick &brickContaining(unsigned level, const glm::ivec3 &local_key) const
+  {
+    return brick(level, local_key / brickSize(level));
+  }
+
+  /// Access the summary of the entire region. Must only be called after @c build() .
+  /// @return The top level brick.
+  inline const OccupancyBrick &regionBrick() const { return levels_.back().front(); }
+
+  /// Calculate the number of voxels along the X axis, starting at @p local_key , which can be skipped as they cannot be
+  /// occupied. This finds the largest brick containing @p local_key which cannot contain occupied voxels and returns
+  /// the distance to the end of that brick.
+  ///
+  /// @param local_key The local voxel coordinate within the region - see @c Key::localKey() .
+  /// @param occupancy_threshold The occupancy threshold value - see @c OccupancyMap::occupancyThresholdValue() .
+  /// @param unobserved_as_occupied Treat unobserved voxels as occupied?
+  /// @return The number of voxels which can be skipped, including @p local_key , or zero if @p local_key may be
+  ///   occupied.
+  int emptyRunLength(const glm::ivec3 &local_key, float occupancy_threshold, bool unobserved_as_occupied) const;
+
+private:
+  /// Brick summaries for each level.
+  std::vector<std::vector<OccupancyBrick>> levels_;
+  /// Number of bricks along each axis for each level.
+  std::vector<glm::ivec3> level_dimensions_;
+  /// The region voxel dimensions used to build the summary.
+  glm::ivec3 region_dimensions_{ 0 };
+  /// The occupancy @c MapChunk::touched_stamps value at the time of the build.
+  uint64_t stamp_ = 0;
+  /// The occupancy layer index used in the build.
+  int layer_index_ = -1;
+};
+
+/// Update the @c MapChunk::occupancy_summary for @p chunk if required. This builds the summary if it is missing or out
+/// of date with the chunk's occupancy layer.
+///
+/// Not threadsafe: the chunk must not be modified or summarised concurrently.
+///
+/// @param chunk The chunk to update the summary for.
+/// @return The up to date summary, or null if the map was not created with @c MapFlag::kOccupancySummary .
+const RegionOccupancySummary ohm_API *updateOccupancySummary(MapChunk &chunk);
+
+/// Access the @c MapChunk::occupancy_summary for @p chunk only if it is up to date.
+///
+/// This does not modify the summary and may be called concurrently, so long as the chunk is not being modified.
+///
+/// @param chunk The chunk of interest.
+/// @return The up to date summary, or null if there is no summary or it is out of date.
+const RegionOccupancySummary ohm_API *currentOccupancySummary(const MapChunk &chunk);
+
+/// Update the occupancy summary for each existing region in @p map which overlaps the given extents. Does nothing
+/// unless @p map was created with @c MapFlag::kOccupancySummary .
+///
+/// This is intended to be called before a threaded query so the query can use @c currentOccupancySummary() .
+///
+/// @param map The map to update summaries in.
+/// @param min_ext The lower extents of the update AABB in global coordinates.
+/// @param max_ext The upper extents of the update AABB in global coordinates.
+void ohm_API updateOccupancySummaries(OccupancyMap &map, const glm::dvec3 &min_ext, const glm::dvec3 &max_ext);
+}  // namespace ohm
+
+#endif  // OHM_OCCUPANCYSUMMARY_H
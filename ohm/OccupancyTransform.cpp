@@ -0,0 +1,210 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OccupancyTransform.h"
+
+#include "DefaultLayer.h"
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "MapProbability.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "Voxel.h"
+#include "VoxelOccupancy.h"
+#include "VoxelSpan.h"
+#include "VoxelTouchTime.h"
+
+#include <ohmutil/Profile.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace ohm
+{
+void decayOccupancy(OccupancyMap &map, float decay_factor, bool use_threads)
+{
+  PROFILE(decayOccupancy);
+  decay_factor = std::max(0.0f, std::min(decay_factor, 1.0f));
+  // Saturated values are only locked when the saturation flags are set. Otherwise use limits which never match.
+  const float locked_min = map.saturateAtMinValue() ? map.minVoxelValue() : -std::numeric_limits<float>::max();
+  const float locked_max = map.saturateAtMaxValue() ? map.maxVoxelValue() : std::numeric_limits<float>::max();
+
+  transformVoxelSpans<float>(
+    map, map.layout().occupancyLayer(),
+    [decay_factor, locked_min, locked_max](const VoxelSpan<float> &occupancy, unsigned /*worker_index*/)  //
+    {
+      float *values = occupancy.data();
+      const size_t count = occupancy.size();
+      // Branch free so the loop vectorises. Unobserved values are infinite so fail the range test and are kept.
+      for (size_t i = 0; i < count; ++i)
+      {
+        const float value = values[i];
+        const bool keep = !(value > locked_min && value < locked_max);
+        values[i] = keep ? value : value * decay_factor;
+      }
+    },
+    use_threads);
+}
+
+
+float decayedOccupancy(const OccupancyMap &map, const Key &key, double timestamp)
+{
+  const Voxel<const float> occupancy(&map, map.layout().occupancyLayer(), key);
+  if (!occupancy.isValid())
+  {
+    return unobservedOccupancyValue();
+  }
+
+  const float value = occupancy.data();
+  const Voxel<const uint32_t> touch_time(&map, map.layout().layerIndex(default_layer::touchTimeLayerName()), key);
+  if (map.occupancyDecayTime() <= 0 || !touch_time.isValid())
+  {
+    return value;
+  }
+
+  const float locked_min = map.saturateAtMinValue() ? map.minVoxelValue() : std::numeric_limits<float>::lowest();
+  const float locked_max = map.saturateAtMaxValue() ? map.maxVoxelValue() : std::numeric_limits<float>::max();
+  const double elapsed = timestamp - decodeVoxelTouchTime(map.firstRayTime(), touch_time.data());
+  return decayedOccupancyValue(value, elapsed, map.occupancyDecayTime(), locked_min, locked_max);
+}
+
+
+bool isRegionDecayed(const OccupancyMap &map, const MapChunk &chunk, double timestamp, float epsilon_value)
+{
+  const double decay_time = map.occupancyDecayTime();
+  const int touch_time_layer = map.layout().layerIndex(default_layer::touchTimeLayerName());
+  if (decay_time <= 0 || touch_time_layer < 0)
+  {
+    return false;
+  }
+
+  const VoxelSpan<const float> occupancy(&chunk, map, map.layout().occupancyLayer());
+  const VoxelSpan<const uint32_t> touch_time(&chunk, map, touch_time_layer);
+  if (!occupancy.isValid() || !touch_time.isValid() || occupancy.size() != touch_time.size() ||
+      occupancy.keyDecoder().order() != touch_time.keyDecoder().order())
+  {
+    return false;
+  }
+
+  const float locked_min = map.saturateAtMinValue() ? map.minVoxelValue() : std::numeric_limits<float>::lowest();
+  const float locked_max = map.saturateAtMaxValue() ? map.maxVoxelValue() : std::numeric_limits<float>::max();
+  const double time_base = map.firstRayTime();
+  // Stop at the first voxel which retains information.
+  for (size_t i = 0; i < occupancy.size(); ++i)
+  {
+    const float value = occupancy[i];
+    if (value == unobservedOccupancyValue())
+    {
+      continue;
+    }
+
+    if (!(value > locked_min && value < locked_max))
+    {
+      // Saturation locked voxels never decay.
+      return false;
+    }
+
+    const double elapsed = timestamp - decodeVoxelTouchTime(time_base, touch_time[i]);
+    if (std::abs(decayedOccupancyValue(value, elapsed, decay_time, locked_min, locked_max)) >= epsilon_value)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+void clampOccupancy(OccupancyMap &map, bool use_threads)
+{
+  PROFILE(clampOccupancy);
+  const float min_value = map.minVoxelValue();
+  const float max_value = map.maxVoxelValue();
+
+  transformVoxelSpans<float>(
+    map, map.layout().occupancyLayer(),
+    [min_value, max_value](const VoxelSpan<float> &occupancy, unsigned /*worker_index*/)  //
+    {
+      float *values = occupancy.data();
+      const size_t count = occupancy.size();
+      for (size_t i = 0; i < count; ++i)
+      {
+        const float value = values[i];
+        const float clamped = std::max(min_value, std::min(value, max_value));
+        values[i] = (value == unobservedOccupancyValue()) ? value : clamped;
+      }
+    },
+    use_threads);
+}
+
+
+bool thresholdOccupancy(OccupancyMap &map, float occupancy_probability, bool use_threads)
+{
+  PROFILE(thresholdOccupancy);
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+  if ((region_dim.x & 1u) || (region_dim.y & 1u) || (region_dim.z & 1u))
+  {
+    return false;
+  }
+
+  map.addLayer(default_layer::occupancyMaskLayerName(), [](MapLayout &layout) { addOccupancyMask(layout); });
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int mask_layer = map.layout().layerIndex(default_layer::occupancyMaskLayerName());
+  const float threshold_value = probabilityToValue(occupancy_probability);
+  const uint64_t stamp = map.touch();
+
+  parallelForEachRegion(
+    map,
+    [&map, occupancy_layer, mask_layer, threshold_value, stamp, region_dim](
+      const MapChunk &chunk, size_t /*region_index*/, unsigned /*worker_index*/)  //
+    {
+      const VoxelSpan<const float> occupancy(&chunk, map, occupancy_layer);
+      // The map is mutable, so its chunks are too.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      VoxelSpan<uint8_t> mask(const_cast<MapChunk *>(&chunk), map, mask_layer);
+      if (!occupancy.isValid() || !mask.isValid())
+      {
+        return;
+      }
+
+      std::fill(mask.begin(), mask.end(), uint8_t(0u));
+      const VoxelKeyDecoder &occupancy_keys = occupancy.keyDecoder();
+      const VoxelKeyDecoder &mask_keys = mask.keyDecoder();
+      glm::u8vec3 local_key(0);
+      for (local_key.z = 0; local_key.z < region_dim.z; ++local_key.z)
+      {
+        for (local_key.y = 0; local_key.y < region_dim.y; ++local_key.y)
+        {
+          for (local_key.x = 0; local_key.x < region_dim.x; ++local_key.x)
+          {
+            const float value = occupancy[occupancy_keys.index(local_key)];
+            const bool occupied = value >= threshold_value && value != unobservedOccupancyValue();
+            const unsigned mask_index = mask_keys.index(local_key / uint8_t(2));
+            mask[mask_index] = uint8_t(mask[mask_index] | (unsigned(occupied) << occupancyMaskBit(local_key)));
+          }
+        }
+      }
+
+      mask.touch(stamp);
+    },
+    use_threads);
+
+  return true;
+}
+
+
+bool isMaskOccupied(const OccupancyMap &map, const Key &key)
+{
+  const Voxel<const uint8_t> mask(&map, map.layout().layerIndex(default_layer::occupancyMaskLayerName()),
+                                  Key(key.regionKey(), key.localKey() / uint8_t(2)));
+  if (!mask.isValid())
+  {
+    return false;
+  }
+  return (mask.data() & (1u << occupancyMaskBit(key.localKey()))) != 0;
+}
+}  // namespace ohm
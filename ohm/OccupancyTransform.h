@@ -0,0 +1,126 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_OCCUPANCYTRANSFORM_H
+#define OHM_OCCUPANCYTRANSFORM_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <cmath>
+
+namespace ohm
+{
+class OccupancyMap;
+class Key;
+struct MapChunk;
+
+/// @defgroup occupancytransform Bulk occupancy transforms
+/// Bulk operations on the occupancy layer of an @c OccupancyMap .
+///
+/// These functions update the occupancy layer of every region as a linear pass over the layer memory - see
+/// @c VoxelSpan - rather than stepping a @c Voxel through every voxel. Regions are processed in parallel when built
+/// with @c OHM_FEATURE_THREADS and @c use_threads is set. Unobserved voxels are never modified.
+///
+/// The transforms operate on the CPU map data. A @c GpuMap must synchronise the GPU cache to the CPU before
+/// calling these functions and clear the GPU cache afterwards to pick up the changes.
+
+/// @ingroup occupancytransform
+/// Decay observed occupancy values towards the uncertain, 0.5 probability prior by scaling the log odds values by
+/// @p decay_factor . Voxels locked at a saturation limit (see @c OccupancyMap::saturateAtMinValue() and
+/// @c OccupancyMap::saturateAtMaxValue() ) are not modified.
+///
+/// Use `exp(-dt / tau)` as the @p decay_factor to decay with a time constant @c tau over the interval @c dt .
+///
+/// @param map The map to modify.
+/// @param decay_factor The log odds scale factor in the range [0, 1]. Zero makes observed voxels uncertain.
+/// @param use_threads Allow regions to be processed in parallel?
+void ohm_API decayOccupancy(OccupancyMap &map, float decay_factor, bool use_threads = true);
+
+/// @ingroup occupancytransform
+/// Decay a single occupancy @p value towards the uncertain prior over @p elapsed seconds with time constant
+/// @p decay_time . This is the per voxel form of @c decayOccupancy() used for lazy decay - see
+/// @c OccupancyMap::setOccupancyDecayTime() .
+///
+/// Unobserved values and values outside the open range ( @p locked_min , @p locked_max ) are not modified. Nothing
+/// decays when @p elapsed or @p decay_time are not positive.
+/// @param value The occupancy value to decay.
+/// @param elapsed The time elapsed since the value was last updated (seconds).
+/// @param decay_time The decay time constant (seconds).
+/// @param locked_min Values at or below this are saturation locked. The map minimum when saturating at the minimum,
+///   otherwise the lowest float.
+/// @param locked_max Values at or above this are saturation locked. The map maximum when saturating at the maximum,
+///   otherwise the maximum float.
+/// @return The decayed value.
+inline float decayedOccupancyValue(float value, double elapsed, double decay_time, float locked_min, float locked_max)
+{
+  const bool keep = decay_time <= 0 || elapsed <= 0 || !(value > locked_min && value < locked_max);
+  return keep ? value : value * float(std::exp(-elapsed / decay_time));
+}
+
+/// @ingroup occupancytransform
+/// Read the occupancy value of the voxel at @p key decayed to @p timestamp according to the map
+/// @c OccupancyMap::occupancyDecayTime() and the voxel touch time. The stored value is returned when decay is
+/// disabled or the map has no touch time layer. The map is not modified.
+///
+/// Use this in place of reading the occupancy layer directly when the map is configured for lazy decay.
+/// @param map The map to query.
+/// @param key The voxel of interest.
+/// @param timestamp The time to evaluate the decay at. Generally the latest sensor time.
+/// @return The decayed occupancy value or @c unobservedOccupancyValue() if the voxel region does not exist.
+float ohm_API decayedOccupancy(const OccupancyMap &map, const Key &key, double timestamp);
+
+/// @ingroup occupancytransform
+/// Check whether all the observed voxels of @p chunk have decayed to within @p epsilon_value of the uncertain prior
+/// at @p timestamp - see @c OccupancyMap::setOccupancyDecayTime() . Such a region holds no meaningful information and
+/// may be removed. Returns false when decay is disabled, the map has no touch time layer or any voxel is saturation
+/// locked.
+/// @param map The map containing @p chunk .
+/// @param chunk The region to check.
+/// @param timestamp The time to evaluate the decay at.
+/// @param epsilon_value Log odds magnitude below which a voxel is considered fully decayed.
+/// @return True if the region has fully decayed.
+bool ohm_API isRegionDecayed(const OccupancyMap &map, const MapChunk &chunk, double timestamp, float epsilon_value);
+
+/// @ingroup occupancytransform
+/// Clamp observed occupancy values to the range [ @c OccupancyMap::minVoxelValue() ,
+/// @c OccupancyMap::maxVoxelValue() ]. This is intended for use after changing the map value limits.
+/// @param map The map to modify.
+/// @param use_threads Allow regions to be processed in parallel?
+void ohm_API clampOccupancy(OccupancyMap &map, bool use_threads = true);
+
+/// @ingroup occupancytransform
+/// Threshold the occupancy layer into the occupancy bitmask layer - see @c addOccupancyMask() . The layer is added if
+/// not present. A bit is set for each observed voxel with an occupancy probability at or above
+/// @p occupancy_probability and cleared for all other voxels.
+///
+/// The bitmask requires even region voxel dimensions.
+///
+/// @param map The map to update.
+/// @param occupancy_probability The occupancy probability threshold. Typically
+///   @c OccupancyMap::occupancyThresholdProbability() .
+/// @param use_threads Allow regions to be processed in parallel?
+/// @return False if the region voxel dimensions are not even, in which case the map is unchanged.
+bool ohm_API thresholdOccupancy(OccupancyMap &map, float occupancy_probability, bool use_threads = true);
+
+/// @ingroup occupancytransform
+/// Query the occupancy bitmask bit for a voxel within its mask voxel.
+/// @param local_key The voxel @c Key::localKey() .
+/// @return The bit index [0, 8) in the mask voxel.
+inline unsigned occupancyMaskBit(const glm::u8vec3 &local_key)
+{
+  return unsigned(local_key.x & 1u) | (unsigned(local_key.y & 1u) << 1u) | (unsigned(local_key.z & 1u) << 2u);
+}
+
+/// @ingroup occupancytransform
+/// Query the occupancy bitmask for the voxel at @p key as generated by @c thresholdOccupancy() .
+/// @param map The map to query.
+/// @param key The voxel of interest.
+/// @return True if the mask bit is set. False if not set, or the mask layer or region do not exist.
+bool ohm_API isMaskOccupied(const OccupancyMap &map, const Key &key);
+}  // namespace ohm
+
+#endif  // OHM_OCCUPANCYTRANSFORM_H
@@ -33,8 +33,13 @@
 #cmakedefine OHM_VALIDATION
 #cmakedefine OHM_FEATURE_THREADS
 #cmakedefine OHM_PROFILE
+// Enable memory tracking by subsystem. See MemoryTrack.h
+#cmakedefine OHM_MEMORY_TRACK
 #cmakedefine OHM_EMBED_GPU_CODE
 #cmakedefine OHM_FEATURE_EIGEN
+#cmakedefine OHM_FEATURE_LZ4
+#cmakedefine OHM_FEATURE_ZSTD
+#cmakedefine OHM_FEATURE_URING
 
 #ifdef OHM_PROFILE
 #define PROFILING 1
@@ -0,0 +1,269 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ParallelForEach.h"
+
+#include "MapChunk.h"
+#include "OccupancyMap.h"
+#include "TaskArena.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+// NUMA constrained task arenas are available from oneTBB.
+#if defined(__has_include)
+#if __has_include(<tbb/info.h>) && __has_include(<tbb/task_group.h>)
+#include <tbb/info.h>
+#include <tbb/task_group.h>
+#if TBB_INTERFACE_VERSION >= 12000
+#define OHM_NUMA_ARENAS 1
+#endif  // TBB_INTERFACE_VERSION >= 12000
+#endif  // __has_include(<tbb/info.h>) && __has_include(<tbb/task_group.h>)
+#endif  // defined(__has_include)
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+
+namespace ohm
+{
+namespace
+{
+#ifdef OHM_NUMA_ARENAS
+/// One task arena for each NUMA node, constrained to the cores of that node. Created on first use.
+class NumaArenas
+{
+public:
+  static NumaArenas &instance()
+  {
+    static NumaArenas arenas;
+    return arenas;
+  }
+
+  inline size_t size() const { return arenas_.size(); }
+  inline tbb::task_arena &arena(size_t node) { return *arenas_[node]; }
+
+private:
+  NumaArenas()
+  {
+    // A single node is reported when the topology is unavailable, such as when the tbbbind library is missing.
+    const std::vector<tbb::numa_node_id> nodes = tbb::info::numa_nodes();
+    if (nodes.size() > 1)
+    {
+      for (const tbb::numa_node_id node : nodes)
+      {
+        arenas_.emplace_back(std::make_unique<tbb::task_arena>(tbb::task_arena::constraints(node)));
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<tbb::task_arena>> arenas_;
+};
+#endif  // OHM_NUMA_ARENAS
+
+/// Floor division of a region coordinate into @c kNumaRegionBlock blocks.
+inline int numaBlockCoord(int coord)
+{
+  return (coord >= 0) ? coord / kNumaRegionBlock : -((-coord + kNumaRegionBlock - 1) / kNumaRegionBlock);
+}
+}  // namespace
+
+
+unsigned parallelWorkerCount()
+{
+#ifdef OHM_FEATURE_THREADS
+  // Cover worker indices from both the installed ohm arena and the arena of the calling thread.
+  return std::max(parallelConcurrency(), unsigned(std::max(1, tbb::this_task_arena::max_concurrency())));
+#else   // OHM_FEATURE_THREADS
+  return 1u;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+void parallelForEachRegion(const std::vector<const MapChunk *> &chunks, const RegionVisitFunction &visit,
+                           bool use_threads)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads && chunks.size() > 1)
+  {
+    const auto visit_regions = [&chunks, &visit](const tbb::blocked_range<size_t> &range) {
+      const auto worker_index = unsigned(tbb::this_task_arena::current_thread_index());
+      // Isolate the visit so this thread cannot pick up another region, with the same worker index, should the visit
+      // function wait on nested parallel work.
+      tbb::this_task_arena::isolate([&chunks, &visit, &range, worker_index]() {
+        for (size_t i = range.begin(); i < range.end(); ++i)
+        {
+          visit(*chunks[i], i, worker_index);
+        }
+      });
+    };
+    parallelExecute([&chunks, &visit_regions]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, chunks.size()), visit_regions);
+    });
+    return;
+  }
+#endif  // OHM_FEATURE_THREADS
+  (void)use_threads;
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    visit(*chunks[i], i, 0u);
+  }
+}
+
+
+void parallelForEachRegion(const OccupancyMap &map, const RegionVisitFunction &visit, bool use_threads)
+{
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  parallelForEachRegion(chunks, visit, use_threads);
+}
+
+
+size_t parallelFetchRegions(const OccupancyMap &map, const std::vector<glm::i16vec3> &region_keys,
+                            std::vector<const MapChunk *> &chunks, bool use_threads)
+{
+  std::vector<const MapChunk *> fetched(region_keys.size(), nullptr);
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads && region_keys.size() > 1)
+  {
+    // Page in is thread safe and each region is loaded once, so regions may be fetched concurrently.
+    parallelExecute([&map, &region_keys, &fetched]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, region_keys.size()),
+                        [&map, &region_keys, &fetched](const tbb::blocked_range<size_t> &range) {
+                          for (size_t i = range.begin(); i < range.end(); ++i)
+                          {
+                            fetched[i] = map.region(region_keys[i]);
+                          }
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    for (size_t i = 0; i < region_keys.size(); ++i)
+    {
+      fetched[i] = map.region(region_keys[i]);
+    }
+  }
+
+  const size_t initial_size = chunks.size();
+  std::copy_if(fetched.begin(), fetched.end(), std::back_inserter(chunks),
+               [](const MapChunk *chunk) { return chunk != nullptr; });
+  return chunks.size() - initial_size;
+}
+
+
+void parallelForEachVoxel(const OccupancyMap &map, const VoxelVisitFunction &visit, bool use_threads)
+{
+  const glm::ivec3 region_voxel_dimensions = map.regionVoxelDimensions();
+  parallelForEachRegion(
+    map,
+    [&visit, &region_voxel_dimensions](const MapChunk &chunk, size_t /*region_index*/, unsigned worker_index) {
+      forEachVoxelInRegion(chunk, region_voxel_dimensions,
+                           [&visit, &chunk, worker_index](const Key &key) { visit(key, chunk, worker_index); });
+    },
+    use_threads);
+}
+
+
+unsigned numaNodeCount()
+{
+#ifdef OHM_NUMA_ARENAS
+  return unsigned(std::max<size_t>(1u, NumaArenas::instance().size()));
+#else   // OHM_NUMA_ARENAS
+  return 1u;
+#endif  // OHM_NUMA_ARENAS
+}
+
+
+unsigned regionNumaNode(const glm::i16vec3 &region_key, unsigned node_count)
+{
+  if (node_count < 2)
+  {
+    return 0;
+  }
+
+  const uint32_t hash = (uint32_t(numaBlockCoord(region_key.x)) * 73856093u) ^
+                        (uint32_t(numaBlockCoord(region_key.y)) * 19349663u) ^
+                        (uint32_t(numaBlockCoord(region_key.z)) * 83492791u);
+  return hash % node_count;
+}
+
+
+void parallelForNuma(const std::vector<unsigned> &item_nodes, const std::function<void(size_t)> &visit,
+                     bool use_threads)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads && item_nodes.size() > 1)
+  {
+#ifdef OHM_NUMA_ARENAS
+    NumaArenas &numa = NumaArenas::instance();
+    if (numa.size() > 1)
+    {
+      const size_t node_count = numa.size();
+      std::vector<std::vector<size_t>> node_items(node_count);
+      for (size_t i = 0; i < item_nodes.size(); ++i)
+      {
+        node_items[std::min<size_t>(item_nodes[i], node_count - 1u)].emplace_back(i);
+      }
+
+      // Start the work for every node before waiting on any node so the nodes run concurrently.
+      std::vector<tbb::task_group> node_tasks(node_count);
+      for (size_t node = 0; node < node_count; ++node)
+      {
+        const std::vector<size_t> &items = node_items[node];
+        if (!items.empty())
+        {
+          tbb::task_group &tasks = node_tasks[node];
+          numa.arena(node).execute([&tasks, &items, &visit]() {
+            tasks.run([&items, &visit]() {
+              tbb::parallel_for(tbb::blocked_range<size_t>(0u, items.size()),
+                                [&items, &visit](const tbb::blocked_range<size_t> &range) {
+                                  for (size_t i = range.begin(); i < range.end(); ++i)
+                                  {
+                                    visit(items[i]);
+                                  }
+                                });
+            });
+          });
+        }
+      }
+
+      for (size_t node = 0; node < node_count; ++node)
+      {
+        if (!node_items[node].empty())
+        {
+          tbb::task_group &tasks = node_tasks[node];
+          numa.arena(node).execute([&tasks]() { tasks.wait(); });
+        }
+      }
+      return;
+    }
+#endif  // OHM_NUMA_ARENAS
+
+    parallelExecute([&item_nodes, &visit]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, item_nodes.size()),
+                        [&visit](const tbb::blocked_range<size_t> &range) {
+                          for (size_t i = range.begin(); i < range.end(); ++i)
+                          {
+                            visit(i);
+                          }
+                        });
+    });
+    return;
+  }
+#endif  // OHM_FEATURE_THREADS
+  (void)use_threads;
+  for (size_t i = 0; i < item_nodes.size(); ++i)
+  {
+    visit(i);
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,253 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_PARALLELFOREACH_H
+#define OHM_PARALLELFOREACH_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "OccupancyMap.h"
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace ohm
+{
+/// Function signature used by @c parallelForEachRegion() to visit each @c MapChunk .
+///
+/// The arguments are the chunk being visited, the index of that chunk in the visited chunk list and the index of the
+/// worker invoking the function. The worker index is in the range `[0, parallelWorkerCount())` and may be used to
+/// address per worker state such as in a @c WorkerLocal . No two regions are visited concurrently with the same worker
+/// index.
+using RegionVisitFunction = std::function<void(const MapChunk &, size_t, unsigned)>;
+
+/// Function signature used by @c parallelForEachVoxel() to visit each voxel. The arguments are the voxel @c Key , the
+/// @c MapChunk containing the voxel and the worker index as for @c RegionVisitFunction .
+using VoxelVisitFunction = std::function<void(const Key &, const MapChunk &, unsigned)>;
+
+/// Query the number of workers which may be used by @c parallelForEachRegion() and derived functions. This is the
+/// number of per worker items required to support the worker index passed to a @c RegionVisitFunction .
+///
+/// This is always 1 when not built with @c OHM_FEATURE_THREADS .
+///
+/// @return The maximum number of concurrent workers.
+unsigned ohm_API parallelWorkerCount();
+
+/// Visit each of the given @p chunks , potentially in parallel.
+///
+/// When built with @c OHM_FEATURE_THREADS and @p use_threads is set, the chunks are dispatched to TBB worker threads.
+/// Each chunk is visited exactly once, but the visit order is undefined. Otherwise the chunks are visited in order on
+/// the calling thread with a zero worker index.
+///
+/// The @p visit function is invoked concurrently and must only read the map, or modify data belonging to the visited
+/// chunk. Per worker state, such as @c Voxel objects, should be addressed by the worker index - see @c WorkerLocal .
+/// This keeps each worker's @c Voxel objects retaining the @c VoxelBuffer for the chunk being visited without
+/// contention with other workers. Each region visit is isolated, so the @p visit function may itself make use of nested
+/// parallelism without the worker index being reused before the visit completes.
+///
+/// Chunks must not be added to or removed from the map during iteration.
+///
+/// @param chunks The chunks to visit.
+/// @param visit The function to invoke for each chunk.
+/// @param use_threads Allow chunks to be visited in parallel?
+void ohm_API parallelForEachRegion(const std::vector<const MapChunk *> &chunks, const RegionVisitFunction &visit,
+                                   bool use_threads = true);
+
+/// @overload
+/// Visits all the regions in @p map . The region index matches the order given by
+/// @c OccupancyMap::enumerateRegions() , which is also the order regions are visited by @c OccupancyMap::iterator .
+/// @param map The map to visit the regions of.
+/// @param visit The function to invoke for each chunk.
+/// @param use_threads Allow chunks to be visited in parallel?
+void ohm_API parallelForEachRegion(const OccupancyMap &map, const RegionVisitFunction &visit, bool use_threads = true);
+
+/// Fetch the regions at @p region_keys from @p map , potentially in parallel. Regions are paged in from an indexed map
+/// file or a region pager as required - see @c OccupancyMap::region() - so this is the preferred way to load a batch
+/// of regions of a map opened via @c ohm::openIndexed() .
+///
+/// @param map The map to fetch regions from.
+/// @param region_keys The keys of the regions to fetch.
+/// @param[out] chunks The fetched chunks are added to this container, in @p region_keys order. Regions which do not
+///   exist are skipped.
+/// @param use_threads Allow regions to be fetched in parallel?
+/// @return The number of chunks added.
+size_t ohm_API parallelFetchRegions(const OccupancyMap &map, const std::vector<glm::i16vec3> &region_keys,
+                                    std::vector<const MapChunk *> &chunks, bool use_threads = true);
+
+/// The number of regions along each axis of the blocks used to partition regions between NUMA nodes by
+/// @c regionNumaNode() .
+constexpr int kNumaRegionBlock = 4;
+
+/// Query the number of NUMA nodes used by @c parallelForNuma() .
+///
+/// This requires @c OHM_FEATURE_THREADS and a TBB build with NUMA support (oneTBB with its @c tbbbind library
+/// available). Otherwise this is always 1.
+///
+/// @return The number of NUMA nodes.
+unsigned ohm_API numaNodeCount();
+
+/// Select the NUMA node for the region at @p region_key when partitioning regions between @p node_count nodes.
+///
+/// Regions are partitioned in blocks of @c kNumaRegionBlock regions along each axis, so that neighbouring regions -
+/// which are generally updated by the same rays - are placed on the same node.
+///
+/// @param region_key The region of interest.
+/// @param node_count The number of nodes to partition between - see @c numaNodeCount() .
+/// @return The node index in the range `[0, node_count)` . Zero when @p node_count is less than 2.
+unsigned ohm_API regionNumaNode(const glm::i16vec3 &region_key, unsigned node_count);
+
+/// Invoke @p visit for each index in `[0, item_nodes.size())` , potentially in parallel, running each item on a worker
+/// bound to the NUMA node given by @p item_nodes .
+///
+/// With multiple @c numaNodeCount() , the items for each node are processed in parallel by a TBB task arena
+/// constrained to that node, with all nodes running concurrently. Memory first touched by the @p visit function is
+/// thus allocated local to the item's node by the operating system. Otherwise this behaves as a @c tbb::parallel_for
+/// over the items, or a serial loop when not using threads.
+///
+/// The worker index is not available as TBB thread indices are only unique within a task arena.
+///
+/// @param item_nodes The NUMA node for each item - see @c regionNumaNode() . Nodes out of range use the last node.
+/// @param visit The function to invoke for each item index.
+/// @param use_threads Allow items to be visited in parallel?
+void ohm_API parallelForNuma(const std::vector<unsigned> &item_nodes, const std::function<void(size_t)> &visit,
+                             bool use_threads = true);
+
+/// Visit every voxel in @p map , potentially in parallel. This visits the same voxels as an @c OccupancyMap::iterator ,
+/// with voxels in each region visited in the same order as the iterator on a single thread. Regions may be visited in
+/// any order and concurrently - see @c parallelForEachRegion() .
+///
+/// @param map The map to visit the voxels of.
+/// @param visit The function to invoke for each voxel.
+/// @param use_threads Allow regions to be visited in parallel?
+void ohm_API parallelForEachVoxel(const OccupancyMap &map, const VoxelVisitFunction &visit, bool use_threads = true);
+
+/// Invoke @p visit for each voxel @c Key in @p chunk in the same order as an @c OccupancyMap::iterator . This starts at
+/// the @c MapChunk::firstValidKey() .
+///
+/// This is intended to visit voxels within a @c RegionVisitFunction .
+///
+/// @param chunk The chunk to visit the voxels of.
+/// @param region_voxel_dimensions The map @c OccupancyMap::regionVoxelDimensions() .
+/// @param visit The function to invoke for each voxel. Must have the signature `void(const Key &)` .
+template <typename Func>
+inline void forEachVoxelInRegion(const MapChunk &chunk, const glm::ivec3 &region_voxel_dimensions, Func &&visit)
+{
+  // Clamp the first valid key to match the OccupancyMap::iterator behaviour for regions with no valid voxels.
+  const glm::u8vec3 first_valid_key = chunk.firstValidKey(region_voxel_dimensions);
+  Key key(chunk.region.coord, std::min<int>(first_valid_key.x, region_voxel_dimensions.x - 1),
+          std::min<int>(first_valid_key.y, region_voxel_dimensions.y - 1),
+          std::min<int>(first_valid_key.z, region_voxel_dimensions.z - 1));
+  do
+  {
+    visit(static_cast<const Key &>(key));
+  } while (nextLocalKey(key, region_voxel_dimensions));
+}
+
+/// Per worker storage for use with @c parallelForEachRegion() and related functions.
+///
+/// This holds one item for each of the @c parallelWorkerCount() workers, addressed by the worker index. Typical usage
+/// is to hold per worker @c Voxel objects, or per worker partial results which are later combined.
+///
+/// @code
+/// ohm::WorkerLocal<ohm::Voxel<const float>> occupancy(ohm::Voxel<const float>(&map, map.layout().occupancyLayer()));
+/// ohm::WorkerLocal<size_t> occupied_count(0u);
+/// ohm::parallelForEachVoxel(map, [&](const ohm::Key &key, const ohm::MapChunk &chunk, unsigned worker_index) {
+///   ohm::Voxel<const float> &voxel = occupancy.local(worker_index);
+///   voxel.setKey(key, &chunk);
+///   if (ohm::isOccupied(voxel))
+///   {
+///     ++occupied_count.local(worker_index);
+///   }
+/// });
+/// const size_t total = occupied_count.combine([](size_t a, size_t b) { return a + b; });
+/// @endcode
+///
+/// @tparam T The item type. Must be copy constructible.
+template <typename T>
+class WorkerLocal
+{
+public:
+  /// Create the per worker items, copying @p initial for each item.
+  /// @param initial The initial value for each item.
+  explicit WorkerLocal(const T &initial = T())
+    : items_(parallelWorkerCount(), initial)
+  {}
+
+  /// Access the item for @p worker_index .
+  /// @param worker_index The worker index as passed to a @c RegionVisitFunction .
+  /// @return The worker's item.
+  inline T &local(unsigned worker_index) { return items_[worker_index]; }
+  /// @overload
+  inline const T &local(unsigned worker_index) const { return items_[worker_index]; }
+
+  /// Query the number of items; one per worker.
+  /// @return The item count.
+  inline size_t size() const { return items_.size(); }
+
+  /// Access the items.
+  /// @return The item array.
+  inline std::vector<T> &items() { return items_; }
+  /// @overload
+  inline const std::vector<T> &items() const { return items_; }
+
+  /// Combine the items in worker index order.
+  /// @param join Function combining two values: `T(const T &, const T &)` .
+  /// @return The combined value.
+  template <typename Join>
+  T combine(Join &&join) const
+  {
+    T result = items_.front();
+    for (size_t i = 1; i < items_.size(); ++i)
+    {
+      result = join(result, items_[i]);
+    }
+    return result;
+  }
+
+private:
+  std::vector<T> items_;
+};
+
+/// Reduce a value over the regions of @p map , potentially in parallel.
+///
+/// The @p region_value function is invoked for each region to calculate a per region value. These are then combined
+/// using @p join in region order on the calling thread, starting with @p identity . The result is deterministic so long
+/// as @p region_value is, regardless of threading.
+///
+/// @param map The map to reduce over.
+/// @param identity The initial value.
+/// @param region_value Function calculating the value for a region: `T(const MapChunk &, unsigned worker_index)` .
+/// @param join Function combining two values: `T(const T &, const T &)` .
+/// @param use_threads Allow regions to be visited in parallel?
+/// @return The reduced value.
+template <typename T, typename RegionValue, typename Join>
+T parallelReduceRegions(const OccupancyMap &map, const T &identity, RegionValue &&region_value, Join &&join,
+                        bool use_threads = true)
+{
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  std::vector<T> region_values(chunks.size(), identity);
+  parallelForEachRegion(
+    chunks,
+    [&region_values, &region_value](const MapChunk &chunk, size_t region_index, unsigned worker_index) {
+      region_values[region_index] = region_value(chunk, worker_index);
+    },
+    use_threads);
+
+  T result = identity;
+  for (const T &value : region_values)
+  {
+    result = join(result, value);
+  }
+  return result;
+}
+}  // namespace ohm
+
+#endif  // OHM_PARALLELFOREACH_H
@@ -0,0 +1,516 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ProjectiveIntegrator.h"
+
+#include "DefaultLayer.h"
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+
+#include <ohmutil/Profile.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace ohm
+{
+namespace
+{
+/// Size of the square pixel tiles of the depth image maximum used to cull regions in @c projectiveRegions() .
+const unsigned kDepthTileSize = 8;
+
+/// Occupancy update selected for a voxel by @c occupancyUpdate() .
+enum ProjectiveOccupancyUpdate : unsigned
+{
+  kPouNone = 0u,  ///< No update.
+  kPouMiss = 1u,  ///< Miss update.
+  kPouHit = 2u    ///< Hit update.
+};
+
+inline bool validDepth(float depth)
+{
+  return depth > 0.0f && std::isfinite(depth);
+}
+
+
+/// Constants for a single @c ProjectiveIntegrator::integrate() call.
+struct ProjectiveParams
+{
+  DepthCamera camera;
+  TsdfOptions tsdf_options;
+  /// Map to camera frame rotation.
+  glm::dmat3 map_to_camera{ 1.0 };
+  /// Camera position in the map frame.
+  glm::dvec3 camera_position{ 0.0 };
+  const float *depth = nullptr;
+  int occupancy_layer = -1;
+  int tsdf_layer = -1;
+  glm::ivec3 region_dim{ 0 };
+  VoxelOrder occupancy_order = VoxelOrder::kRowMajor;
+  VoxelOrder tsdf_order = VoxelOrder::kRowMajor;
+  double resolution = 0;
+  float hit_value = 0;
+  float miss_value = 0;
+  float voxel_min = 0;
+  float voxel_max = 0;
+  float saturation_min = 0;
+  float saturation_max = 0;
+  uint64_t touch_stamp = 0;
+};
+
+
+/// A voxel centre projected into the depth image.
+struct ProjectedVoxel
+{
+  /// Voxel centre in the camera frame.
+  glm::dvec3 camera_point;
+  /// Depth of the pixel the voxel centre projects onto.
+  float pixel_depth;
+};
+
+
+/// Project the voxel @p centre into the depth image.
+/// @return False if the voxel is too close, outside the image or projects onto an invalid pixel.
+inline bool projectVoxel(const ProjectiveParams &params, const glm::dvec3 &centre, ProjectedVoxel *projected)
+{
+  const DepthCamera &camera = params.camera;
+  const glm::dvec3 point = params.map_to_camera * (centre - params.camera_position);
+  if (point.z < camera.min_depth)
+  {
+    return false;
+  }
+
+  // Pixel centres lie at integer image coordinates.
+  const double u = std::floor(camera.fx * point.x / point.z + camera.cx + 0.5);
+  const double v = std::floor(camera.fy * point.y / point.z + camera.cy + 0.5);
+  if (u < 0 || v < 0 || u >= double(camera.width) || v >= double(camera.height))
+  {
+    return false;
+  }
+
+  projected->camera_point = point;
+  projected->pixel_depth = params.depth[size_t(v) * camera.width + size_t(u)];
+  return validDepth(projected->pixel_depth);
+}
+
+
+/// Select the occupancy update for a @p projected voxel.
+inline ProjectiveOccupancyUpdate occupancyUpdate(const ProjectiveParams &params, const ProjectedVoxel &projected)
+{
+  const double voxel_depth = projected.camera_point.z;
+  const double half_voxel = 0.5 * params.resolution;
+  if (projected.pixel_depth > params.camera.max_depth)
+  {
+    // Clipped: free space up to the maximum depth.
+    return (voxel_depth <= params.camera.max_depth) ? kPouMiss : kPouNone;
+  }
+
+  if (voxel_depth > projected.pixel_depth + half_voxel)
+  {
+    return kPouNone;
+  }
+  return (voxel_depth >= projected.pixel_depth - half_voxel) ? kPouHit : kPouMiss;
+}
+
+
+/// Resolve the TSDF sample for a @p projected voxel: the pixel sample along the ray through the voxel @p centre .
+/// @return False if the voxel should not be updated.
+inline bool tsdfSample(const ProjectiveParams &params, const ProjectedVoxel &projected, const glm::dvec3 &centre,
+                       glm::dvec3 *sample)
+{
+  if (projected.pixel_depth > params.camera.max_depth)
+  {
+    return false;
+  }
+
+  const double scale = double(projected.pixel_depth) / projected.camera_point.z;
+  const double sdf = (scale - 1.0) * glm::length(projected.camera_point);
+  if (sdf < -double(params.tsdf_options.default_truncation_distance))
+  {
+    return false;
+  }
+
+  *sample = params.camera_position + (centre - params.camera_position) * scale;
+  return true;
+}
+
+
+/// Update the voxels of the region at @p region_key .
+///
+/// When @p chunk is null, this only probes whether any voxel of the region would be updated, without modifying the
+/// map, so that regions are only created as required.
+///
+/// @return The number of voxels updated or, when probing, 1 if any voxel would be updated and 0 otherwise.
+size_t updateRegion(const ProjectiveParams &params, const OccupancyMap &map, const glm::i16vec3 &region_key,
+                    MapChunk *chunk)
+{
+  const glm::dvec3 region_min = map.regionSpatialMin(region_key);
+  VoxelBuffer<VoxelBlock> occupancy_buffer;
+  VoxelBuffer<VoxelBlock> tsdf_buffer;
+  if (chunk)
+  {
+    if (params.occupancy_layer >= 0)
+    {
+      occupancy_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.occupancy_layer]);
+    }
+    if (params.tsdf_layer >= 0)
+    {
+      tsdf_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.tsdf_layer]);
+    }
+  }
+
+  size_t update_count = 0;
+  ProjectedVoxel projected{};
+  glm::dvec3 sample;
+  glm::u8vec3 local_key;
+  for (int z = 0; z < params.region_dim.z; ++z)
+  {
+    local_key.z = uint8_t(z);
+    for (int y = 0; y < params.region_dim.y; ++y)
+    {
+      local_key.y = uint8_t(y);
+      for (int x = 0; x < params.region_dim.x; ++x)
+      {
+        local_key.x = uint8_t(x);
+        const glm::dvec3 centre = region_min + (glm::dvec3(local_key) + glm::dvec3(0.5)) * params.resolution;
+        if (!projectVoxel(params, centre, &projected))
+        {
+          continue;
+        }
+
+        const ProjectiveOccupancyUpdate occupancy_update =
+          (params.occupancy_layer >= 0) ? occupancyUpdate(params, projected) : kPouNone;
+        const bool tsdf_update = params.tsdf_layer >= 0 && tsdfSample(params, projected, centre, &sample);
+        if (occupancy_update == kPouNone && !tsdf_update)
+        {
+          continue;
+        }
+
+        if (!chunk)
+        {
+          // Probing only.
+          return 1u;
+        }
+
+        if (occupancy_update != kPouNone)
+        {
+          const unsigned voxel_index = voxelIndex(local_key, params.region_dim, params.occupancy_order);
+          float occupancy_value;
+          occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
+          const float initial_value = occupancy_value;
+          if (occupancy_update == kPouHit)
+          {
+            occupancyAdjustHit(&occupancy_value, initial_value, params.hit_value, unobservedOccupancyValue(),
+                               params.voxel_max, params.saturation_min, params.saturation_max, false);
+          }
+          else
+          {
+            occupancyAdjustMiss(&occupancy_value, initial_value, params.miss_value, unobservedOccupancyValue(),
+                                params.voxel_min, params.saturation_min, params.saturation_max, false);
+          }
+          occupancy_buffer.writeVoxel(voxel_index, occupancy_value);
+        }
+
+        if (tsdf_update)
+        {
+          const unsigned voxel_index = voxelIndex(local_key, params.region_dim, params.tsdf_order);
+          VoxelTsdf tsdf_voxel;
+          tsdf_buffer.readVoxel(voxel_index, &tsdf_voxel);
+          calculateTsdf(params.camera_position, sample, centre, params.tsdf_options.default_truncation_distance,
+                        params.tsdf_options.max_weight, params.tsdf_options.dropoff_epsilon,
+                        params.tsdf_options.sparsity_compensation_factor, &tsdf_voxel.weight, &tsdf_voxel.distance);
+          tsdf_buffer.writeVoxel(voxel_index, tsdf_voxel);
+        }
+
+        chunk->updateFirstValid(local_key, params.region_dim);
+        ++update_count;
+      }
+    }
+  }
+
+  if (chunk && update_count)
+  {
+    chunk->markDirty(params.touch_stamp);
+    // Update the touched_stamps with relaxed memory ordering as for RayMapperOccupancy.
+    if (params.occupancy_layer >= 0)
+    {
+      chunk->touched_stamps[params.occupancy_layer].store(params.touch_stamp, std::memory_order_relaxed);
+    }
+    if (params.tsdf_layer >= 0)
+    {
+      chunk->touched_stamps[params.tsdf_layer].store(params.touch_stamp, std::memory_order_relaxed);
+    }
+  }
+
+  return update_count;
+}
+}  // namespace
+
+
+size_t projectiveRegions(const OccupancyMap &map, const DepthCamera &camera, const float *depth,
+                         const glm::dmat4 &camera_to_map, double margin, std::vector<glm::i16vec3> &region_keys)
+{
+  region_keys.clear();
+  if (!depth || camera.width == 0 || camera.height == 0 || camera.fx <= 0 || camera.fy <= 0)
+  {
+    return 0;
+  }
+
+  // Build the tiled maximum depth. Clipped pixels contribute the maximum depth. Tiles without valid pixels are -1.
+  const unsigned tiles_x = (camera.width + kDepthTileSize - 1) / kDepthTileSize;
+  const unsigned tiles_y = (camera.height + kDepthTileSize - 1) / kDepthTileSize;
+  std::vector<float> tile_max(size_t(tiles_x) * tiles_y, -1.0f);
+  float far_depth = -1.0f;
+  for (unsigned v = 0; v < camera.height; ++v)
+  {
+    float *tile_row = tile_max.data() + size_t(v / kDepthTileSize) * tiles_x;
+    for (unsigned u = 0; u < camera.width; ++u)
+    {
+      const float pixel_depth = depth[size_t(v) * camera.width + u];
+      if (validDepth(pixel_depth))
+      {
+        const float clipped_depth = std::min(pixel_depth, float(camera.max_depth));
+        float &tile_depth = tile_row[u / kDepthTileSize];
+        tile_depth = std::max(tile_depth, clipped_depth);
+        far_depth = std::max(far_depth, clipped_depth);
+      }
+    }
+  }
+
+  if (far_depth < 0)
+  {
+    // No valid pixels.
+    return 0;
+  }
+
+  const double far_plane = double(far_depth) + margin;
+  const glm::dmat3 camera_to_map_rotation(camera_to_map);
+  const glm::dmat3 map_to_camera = glm::transpose(camera_to_map_rotation);
+  const glm::dvec3 camera_position(camera_to_map[3]);
+
+  // Frustum corner rays through the image edges at unit depth.
+  const double u_min = -0.5;
+  const double v_min = -0.5;
+  const double u_max = double(camera.width) - 0.5;
+  const double v_max = double(camera.height) - 0.5;
+  const std::array<glm::dvec3, 4> corner_rays = {
+    glm::dvec3((u_min - camera.cx) / camera.fx, (v_min - camera.cy) / camera.fy, 1.0),
+    glm::dvec3((u_max - camera.cx) / camera.fx, (v_min - camera.cy) / camera.fy, 1.0),
+    glm::dvec3((u_max - camera.cx) / camera.fx, (v_max - camera.cy) / camera.fy, 1.0),
+    glm::dvec3((u_min - camera.cx) / camera.fx, (v_max - camera.cy) / camera.fy, 1.0)
+  };
+
+  // Side planes through the camera origin, with normals facing into the frustum.
+  std::array<glm::dvec3, 4> side_normals;
+  const glm::dvec3 frustum_axis = corner_rays[0] + corner_rays[1] + corner_rays[2] + corner_rays[3];
+  glm::dvec3 bounds_min = camera_position;
+  glm::dvec3 bounds_max = camera_position;
+  for (size_t i = 0; i < corner_rays.size(); ++i)
+  {
+    glm::dvec3 normal = glm::normalize(glm::cross(corner_rays[i], corner_rays[(i + 1) % corner_rays.size()]));
+    side_normals[i] = (glm::dot(normal, frustum_axis) < 0) ? -normal : normal;
+    const glm::dvec3 far_corner = camera_position + camera_to_map_rotation * (corner_rays[i] * far_plane);
+    bounds_min = glm::min(bounds_min, far_corner);
+    bounds_max = glm::max(bounds_max, far_corner);
+  }
+
+  const Key min_key = map.voxelKey(bounds_min);
+  const Key max_key = map.voxelKey(bounds_max);
+  if (min_key.isNull() || max_key.isNull())
+  {
+    return 0;
+  }
+
+  const glm::dvec3 region_size = map.regionSpatialResolution();
+  const double region_radius = 0.5 * glm::length(region_size);
+  glm::ivec3 region_coord;
+  for (region_coord.z = min_key.regionKey().z; region_coord.z <= max_key.regionKey().z; ++region_coord.z)
+  {
+    for (region_coord.y = min_key.regionKey().y; region_coord.y <= max_key.regionKey().y; ++region_coord.y)
+    {
+      for (region_coord.x = min_key.regionKey().x; region_coord.x <= max_key.regionKey().x; ++region_coord.x)
+      {
+        const glm::i16vec3 region_key(region_coord);
+        const glm::dvec3 region_min = map.regionSpatialMin(region_key);
+        const glm::dvec3 centre = map_to_camera * (region_min + 0.5 * region_size - camera_position);
+
+        // Bounding sphere frustum cull.
+        bool outside = centre.z + region_radius < camera.min_depth || centre.z - region_radius > far_plane;
+        for (size_t i = 0; !outside && i < side_normals.size(); ++i)
+        {
+          outside = glm::dot(side_normals[i], centre) < -region_radius;
+        }
+        if (outside)
+        {
+          continue;
+        }
+
+        // Depth cull: skip regions entirely behind the observed depth of the pixels they project onto. This requires
+        // the whole region to be in front of the camera.
+        double min_corner_depth = std::numeric_limits<double>::max();
+        glm::dvec2 pixel_min(std::numeric_limits<double>::max());
+        glm::dvec2 pixel_max(std::numeric_limits<double>::lowest());
+        for (unsigned i = 0; i < 8u; ++i)
+        {
+          const glm::dvec3 corner =
+            region_min + glm::dvec3((i & 1u) ? region_size.x : 0.0, (i & 2u) ? region_size.y : 0.0,
+                                    (i & 4u) ? region_size.z : 0.0);
+          const glm::dvec3 point = map_to_camera * (corner - camera_position);
+          min_corner_depth = std::min(min_corner_depth, point.z);
+          if (point.z > 0)
+          {
+            const glm::dvec2 pixel(camera.fx * point.x / point.z + camera.cx,  //
+                                   camera.fy * point.y / point.z + camera.cy);
+            pixel_min = glm::min(pixel_min, pixel);
+            pixel_max = glm::max(pixel_max, pixel);
+          }
+        }
+
+        if (min_corner_depth > 0)
+        {
+          const int tile_x0 = std::max(0, int(std::floor((pixel_min.x + 0.5) / kDepthTileSize)));
+          const int tile_y0 = std::max(0, int(std::floor((pixel_min.y + 0.5) / kDepthTileSize)));
+          const int tile_x1 = std::min(int(tiles_x) - 1, int(std::floor((pixel_max.x + 0.5) / kDepthTileSize)));
+          const int tile_y1 = std::min(int(tiles_y) - 1, int(std::floor((pixel_max.y + 0.5) / kDepthTileSize)));
+          float region_far = -1.0f;
+          for (int ty = tile_y0; ty <= tile_y1; ++ty)
+          {
+            for (int tx = tile_x0; tx <= tile_x1; ++tx)
+            {
+              region_far = std::max(region_far, tile_max[size_t(ty) * tiles_x + size_t(tx)]);
+            }
+          }
+
+          if (region_far < 0 || min_corner_depth > double(region_far) + margin)
+          {
+            continue;
+          }
+        }
+
+        region_keys.emplace_back(region_key);
+      }
+    }
+  }
+
+  return region_keys.size();
+}
+
+
+ProjectiveIntegrator::ProjectiveIntegrator(OccupancyMap *map)
+  : map_(map)
+{
+  if (map_)
+  {
+    occupancy_layer_ = map_->layout().occupancyLayer();
+    tsdf_layer_ = map_->layout().layerIndex(default_layer::tsdfLayerName());
+    fromMapInfo(tsdf_options_, map_->mapInfo());
+  }
+}
+
+
+bool ProjectiveIntegrator::valid() const
+{
+  return map_ && (occupancy_layer_ >= 0 || tsdf_layer_ >= 0);
+}
+
+
+bool ProjectiveIntegrator::useThreads() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return use_threads_;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+size_t ProjectiveIntegrator::integrate(const float *depth, const glm::dmat4 &camera_to_map)
+{
+  PROFILE(ProjectiveIntegrator_integrate);
+  region_count_ = 0;
+  if (!valid() || !depth)
+  {
+    return 0;
+  }
+
+  // Occupancy hits extend half a voxel beyond the surface, TSDF updates extend to the truncation distance.
+  double margin = 0.5 * map_->resolution();
+  if (tsdf_layer_ >= 0)
+  {
+    margin = std::max(margin, double(tsdf_options_.default_truncation_distance));
+  }
+
+  region_count_ = projectiveRegions(*map_, camera_, depth, camera_to_map, margin, region_keys_);
+  if (region_keys_.empty())
+  {
+    return 0;
+  }
+
+  ProjectiveParams params;
+  params.camera = camera_;
+  params.tsdf_options = tsdf_options_;
+  params.map_to_camera = glm::transpose(glm::dmat3(camera_to_map));
+  params.camera_position = glm::dvec3(camera_to_map[3]);
+  params.depth = depth;
+  params.occupancy_layer = occupancy_layer_;
+  params.tsdf_layer = tsdf_layer_;
+  params.region_dim = map_->regionVoxelDimensions();
+  params.occupancy_order = (occupancy_layer_ >= 0) ? map_->layerVoxelOrder(occupancy_layer_) : VoxelOrder::kRowMajor;
+  params.tsdf_order = (tsdf_layer_ >= 0) ? map_->layerVoxelOrder(tsdf_layer_) : VoxelOrder::kRowMajor;
+  params.resolution = map_->resolution();
+  params.hit_value = map_->hitValue();
+  params.miss_value = map_->missValue();
+  params.voxel_min = map_->minVoxelValue();
+  params.voxel_max = map_->maxVoxelValue();
+  params.saturation_min = map_->saturateAtMinValue() ? params.voxel_min : std::numeric_limits<float>::lowest();
+  params.saturation_max = map_->saturateAtMaxValue() ? params.voxel_max : std::numeric_limits<float>::max();
+  // Touch the map to flag changes.
+  params.touch_stamp = map_->touch();
+
+  // Update the regions, placing them on NUMA nodes as RayBatch does so that newly allocated voxel memory is local to
+  // the updating node. Region creation is thread safe. Missing regions are first probed so they are only created when
+  // at least one voxel is updated.
+  const size_t region_count = region_keys_.size();
+  const unsigned numa_nodes = useThreads() ? numaNodeCount() : 1u;
+  std::vector<unsigned> item_nodes(region_count);
+  for (size_t i = 0; i < region_count; ++i)
+  {
+    item_nodes[i] = regionNumaNode(region_keys_[i], numa_nodes);
+  }
+
+  std::vector<size_t> update_counts(region_count, 0u);
+  OccupancyMap &map = *map_;
+  parallelForNuma(
+    item_nodes,
+    [&](size_t index) {
+      const glm::i16vec3 &region_key = region_keys_[index];
+      MapChunk *chunk = map.region(region_key, false);
+      if (!chunk)
+      {
+        if (!updateRegion(params, map, region_key, nullptr))
+        {
+          return;
+        }
+        chunk = map.region(region_key, true);
+      }
+      update_counts[index] = updateRegion(params, map, region_key, chunk);
+    },
+    useThreads());
+
+  size_t update_count = 0;
+  for (size_t count : update_counts)
+  {
+    update_count += count;
+  }
+  return update_count;
+}
+}  // namespace ohm
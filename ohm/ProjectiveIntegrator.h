@@ -0,0 +1,142 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_PROJECTIVEINTEGRATOR_H
+#define OHM_PROJECTIVEINTEGRATOR_H
+
+#include "OhmConfig.h"
+
+#include "VoxelTsdf.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// Pinhole depth camera model for projective integration: x right, y down, z forward.
+struct ohm_API DepthCamera
+{
+  /// Image width (pixels).
+  unsigned width = 640;  // NOLINT(readability-magic-numbers)
+  /// Image height (pixels).
+  unsigned height = 480;  // NOLINT(readability-magic-numbers)
+  /// Focal length along x (pixels).
+  double fx = 525.0;  // NOLINT(readability-magic-numbers)
+  /// Focal length along y (pixels).
+  double fy = 525.0;  // NOLINT(readability-magic-numbers)
+  /// Principal point x (pixels).
+  double cx = 319.5;  // NOLINT(readability-magic-numbers)
+  /// Principal point y (pixels).
+  double cy = 239.5;  // NOLINT(readability-magic-numbers)
+  /// Voxels closer than this depth are not updated (metres).
+  double min_depth = 0.1;  // NOLINT(readability-magic-numbers)
+  /// Depths beyond this value are treated as clipped: free space up to this depth, but no surface (metres).
+  double max_depth = 10.0;  // NOLINT(readability-magic-numbers)
+};
+
+/// Resolve the regions of @p map which may be modified by projective integration of a @p depth image.
+///
+/// Regions are culled against the camera frustum and against a tiled maximum of the @p depth image so that regions
+/// lying entirely behind the observed surfaces, or only seeing invalid pixels, are skipped. This is shared by the
+/// CPU @c ProjectiveIntegrator and the GPU implementation.
+///
+/// @param map The target map.
+/// @param camera The camera model.
+/// @param depth The depth image, @c DepthCamera::width by @c DepthCamera::height in row major order. Depths are along
+///   the camera axis (metres). Zero, negative and non-finite values mark invalid pixels.
+/// @param camera_to_map The camera pose in the map frame.
+/// @param margin Distance beyond the observed depth which may still be updated: e.g., the TSDF truncation distance.
+/// @param[out] region_keys Populated with the keys of the regions to update. Cleared first.
+/// @return The number of @p region_keys .
+size_t ohm_API projectiveRegions(const OccupancyMap &map, const DepthCamera &camera, const float *depth,
+                                 const glm::dmat4 &camera_to_map, double margin,
+                                 std::vector<glm::i16vec3> &region_keys);
+
+/// Integrates depth images into an @c OccupancyMap by projecting voxels into the image, rather than tracing a ray
+/// for each pixel.
+///
+/// Dense depth cameras produce many rays which share most of their voxels, so tracing each ray with
+/// @c walkSegmentKeys() - as @c RayMapperOccupancy and @c RayMapperTsdf do - visits each voxel many times over. The
+/// projective update instead visits each voxel near the camera frustum once. The voxel centre is projected into the
+/// image and updated from the depth of the pixel it falls in, in the style of the voxblox projective integrator.
+///
+/// Updates are made to the layers present in the map:
+/// - Occupancy: voxels within half a voxel of the pixel depth are updated as hits, nearer voxels as misses. Pixels
+///   beyond @c DepthCamera::max_depth only generate misses up to that depth.
+/// - @c VoxelTsdf : voxels with a signed distance above the negative truncation distance are updated with
+///   @c calculateTsdf() , using the pixel sample along the ray through the voxel centre. Pixels beyond
+///   @c DepthCamera::max_depth are ignored.
+///
+/// Voxels behind the observed surface, outside the image, closer than @c DepthCamera::min_depth or projecting onto
+/// invalid pixels are not modified. Each voxel samples a single pixel, so nearby voxels which span several pixels do
+/// not see the pixels around their centre. Other layers, such as @c VoxelMean , traversal and touch time, are not
+/// updated, and the occupancy state layer requires @c updateOccupancyState() afterwards.
+///
+/// Regions are updated in parallel when @c useThreads() is set. Each voxel update depends only on the voxel and the
+/// image, so results match the single threaded update. Regions are culled with @c projectiveRegions() , and only
+/// created when at least one of their voxels is updated.
+class ohm_API ProjectiveIntegrator
+{
+public:
+  /// Create an integrator for @p map .
+  /// @param map The map to update. Must outlive this object.
+  explicit ProjectiveIntegrator(OccupancyMap *map);
+
+  /// Query if the map has an occupancy or @c VoxelTsdf layer to update.
+  /// @return True if @c integrate() will update the map.
+  bool valid() const;
+
+  /// Access the target map.
+  /// @return The target map.
+  inline OccupancyMap *map() const { return map_; }
+
+  /// Set the camera model.
+  /// @param camera The camera model.
+  inline void setCamera(const DepthCamera &camera) { camera_ = camera; }
+  /// Query the camera model.
+  /// @return The camera model.
+  inline const DepthCamera &camera() const { return camera_; }
+
+  /// Set the TSDF update options. Only used when the map has a @c VoxelTsdf layer.
+  /// @param options The TSDF options.
+  inline void setTsdfOptions(const TsdfOptions &options) { tsdf_options_ = options; }
+  /// Query the TSDF update options.
+  /// @return The TSDF options.
+  inline const TsdfOptions &tsdfOptions() const { return tsdf_options_; }
+
+  /// Enable or disable multi-threaded integration. Ignored unless built with @c OHM_FEATURE_THREADS .
+  /// @param use_threads True to enable threaded integration.
+  inline void setUseThreads(bool use_threads) { use_threads_ = use_threads; }
+  /// Is multi-threaded integration enabled? Always false when not built with @c OHM_FEATURE_THREADS .
+  /// @return True if threaded integration is enabled and available.
+  bool useThreads() const;
+
+  /// Integrate a depth image.
+  /// @param depth The depth image, @c DepthCamera::width by @c DepthCamera::height in row major order. Depths are
+  ///   along the camera axis (metres). Zero, negative and non-finite values mark invalid pixels.
+  /// @param camera_to_map The camera pose in the map frame.
+  /// @return The number of voxels updated.
+  size_t integrate(const float *depth, const glm::dmat4 &camera_to_map);
+
+  /// Query the number of regions visited by the last @c integrate() call: those passing @c projectiveRegions() .
+  /// @return The region count.
+  inline size_t regionCount() const { return region_count_; }
+
+private:
+  OccupancyMap *map_ = nullptr;
+  DepthCamera camera_;
+  TsdfOptions tsdf_options_;
+  int occupancy_layer_ = -1;
+  int tsdf_layer_ = -1;
+  size_t region_count_ = 0;
+  bool use_threads_ = false;
+  std::vector<glm::i16vec3> region_keys_;
+};
+}  // namespace ohm
+
+#endif  // OHM_PROJECTIVEINTEGRATOR_H
@@ -9,6 +9,9 @@
 
 #include "QueryFlag.h"
 
+#include <future>
+#include <utility>
+
 namespace ohm
 {
 Query::Query(QueryDetail *detail)
@@ -53,6 +56,22 @@ void Query::setQueryFlags(unsigned flags)
 }
 
 
+void Query::setUseThreads(bool use_threads)
+{
+  imp_->use_threads = use_threads;
+}
+
+
+bool Query::useThreads() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return imp_->use_threads;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
 size_t Query::numberOfResults() const
 {
   return imp_->number_of_results;
@@ -80,13 +99,38 @@ bool Query::execute()
 
 bool Query::executeAsync()
 {
-  return onExecuteAsync();
+  return executeAsync(CompletionFunction());
+}
+
+
+bool Query::executeAsync(CompletionFunction on_complete)
+{
+  // Fail if a previous query is still running. This collects a completed query.
+  if (!wait(0))
+  {
+    return false;
+  }
+
+  imp_->on_complete = std::move(on_complete);
+  if (!onExecuteAsync())
+  {
+    imp_->on_complete = nullptr;
+    return false;
+  }
+
+  return true;
 }
 
 
 void Query::reset(bool hard_reset)
 {
   wait();
+  resetResults(hard_reset);
+}
+
+
+void Query::resetResults(bool hard_reset)
+{
   imp_->intersected_voxels.clear();
   imp_->ranges.clear();
   imp_->number_of_results = 0u;
@@ -96,12 +140,61 @@ void Query::reset(bool hard_reset)
 
 bool Query::wait(unsigned timeout_ms)
 {
-  return onWaitAsync(timeout_ms);
+  if (!onWaitAsync(timeout_ms))
+  {
+    return false;
+  }
+
+  // Notify completion of queries which did not invoke the completion function themselves - i.e., queries which
+  // completed synchronously in onExecuteAsync().
+  if (imp_->on_complete)
+  {
+    CompletionFunction on_complete;
+    std::swap(on_complete, imp_->on_complete);
+    on_complete(*this, true);
+  }
+
+  return true;
 }
 
 
-bool Query::onWaitAsync(unsigned /*timeout_ms*/)
+bool Query::onWaitAsync(unsigned timeout_ms)
 {
-  return false;
+  return imp_->waitCpuAsync(timeout_ms);
+}
+
+
+bool Query::executeCpuAsync(const std::function<bool()> &execute)
+{
+  if (imp_->cpuAsyncPending())
+  {
+    return false;
+  }
+
+  resetResults(false);
+  return completeAsync(execute);
+}
+
+
+bool Query::completeAsync(const std::function<bool()> &complete)
+{
+  if (imp_->cpuAsyncPending())
+  {
+    return false;
+  }
+
+  // The completion function is passed to the thread so wait() does not invoke it again.
+  CompletionFunction on_complete;
+  std::swap(on_complete, imp_->on_complete);
+  imp_->cpu_async = std::async(std::launch::async, [this, complete, on_complete]() {
+    const bool ok = complete();
+    if (on_complete)
+    {
+      on_complete(*this, ok);
+    }
+    return ok;
+  });
+
+  return true;
 }
 }  // namespace ohm
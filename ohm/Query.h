@@ -9,6 +9,7 @@
 #include "OhmConfig.h"
 
 #include <cstddef>
+#include <functional>
 
 namespace ohm
 {
@@ -28,10 +29,24 @@ struct QueryDetail;
 /// @c QF_UnknownAsOccupied ensures that @c OccupancyType::kUnobserved are also considered as relevant obstructions.
 /// We define the set of such relevant voxels as the set of @em obstructed voxels.
 ///
+/// Asynchronous execution via @c executeAsync() is supported for all the CPU queries in ohm; the query runs on a
+/// background thread, while GPU queries run on their GPU queue. Completion may be polled or awaited with a timeout via
+/// @c wait() , which blocks on the completion signal without spinning, or notified via a @c CompletionFunction . The
+/// query must not be modified, nor its results read, until the query completes.
+///
 /// @todo Create a base class for the @c Query called @c MapOperation. @c Query adds the concept of results, which
 /// @c MapOperation does not have.
 class ohm_API Query
 {
+public:
+  /// Function invoked on completion of an @c executeAsync() call. The arguments are the completed query and the
+  /// query success. Results are available on invocation.
+  ///
+  /// The function is invoked on a background thread as soon as the query completes - the thread executing a CPU
+  /// query, or the thread awaiting the GPU completion event for a GPU query - without requiring a @c wait() call. It
+  /// must not call @c wait() , @c reset() or execute another query on the same object.
+  using CompletionFunction = std::function<void(Query &, bool)>;
+
 protected:
   /// Constructor. The @p detail is stored in @p imp_, allowing derived classes to a allocate
   /// derived detail structure. When null, the base implementation is allocated by this constructor.
@@ -58,6 +73,15 @@ public:
   /// @param flags The new @c QueryFlag value set for this query.
   void setQueryFlags(unsigned flags);
 
+  /// Enable or disable multi-threaded CPU evaluation for queries which support it, such as @c RaysQuery and
+  /// @c LineKeysQuery . Ignored unless built with @c OHM_FEATURE_THREADS . Enabled by default.
+  /// @param use_threads True to enable threaded evaluation.
+  void setUseThreads(bool use_threads);
+
+  /// Is multi-threaded CPU evaluation enabled? Always false when not built with @c OHM_FEATURE_THREADS .
+  /// @return True if threaded evaluation is enabled and available.
+  bool useThreads() const;
+
   /// Query the number of available results.
   ///
   /// This affects the number of items available from methods such as @p intersectedVoxel().
@@ -97,11 +121,16 @@ public:
   /// This calls through to the implementation in @p onExecuteAsync(). On success, completion
   /// can be synchronised by calling @p wait() with an optional wait timeout.
   ///
-  /// The method will fail when already executing a query.
+  /// The method will fail when already executing a query. A previous query which has completed, but has not been
+  /// collected via @c wait() , is collected first.
   ///
   /// @return True on successfully starting query execution.
   bool executeAsync();
 
+  /// @overload
+  /// @param on_complete Function to invoke when the query completes. See @c CompletionFunction . May be empty.
+  bool executeAsync(CompletionFunction on_complete);
+
   /// Wait for/terminate any asynchronous query and clear results data. This will also wait
   /// for any oustanding asynchronous query.
   ///
@@ -115,7 +144,9 @@ public:
 
   /// Wait for an asynchronous query to complete.
   ///
-  /// @param timeout_ms Maximum amount of time to wait for completion (milliseconds).
+  /// A zero @p timeout_ms polls for completion without blocking, which is suitable for use from a control loop.
+  ///
+  /// @param timeout_ms Maximum amount of time to wait for completion (milliseconds). Use ~0u to wait indefinitely.
   /// @return True if on return there is no asynchronous query running. This does not mean that there was
   ///   one running to begin with.
   bool wait(unsigned timeout_ms = ~0u);
@@ -143,11 +174,40 @@ protected:
   virtual bool onExecuteAsync() = 0;
 
   /// Wait for an asynchronous query to complete.
-  /// @param timeout_ms Maximum time to wait (milliseconds) - zero to wait indefinitely.
-  /// @return True if the query completed before the timeout.
-  /// @todo (KS): make pure virtual
+  ///
+  /// The default implementation waits on a query started by @c executeCpuAsync() or @c completeAsync() .
+  ///
+  /// @param timeout_ms Maximum time to wait (milliseconds) - ~0u to wait indefinitely.
+  /// @return True if no query is running on return.
   virtual bool onWaitAsync(unsigned timeout_ms);
 
+  /// Helper for implementing @c onExecuteAsync() on CPU. Runs @p execute on a background thread after clearing the
+  /// current results, invoking any @c CompletionFunction given to @c executeAsync() on completion.
+  ///
+  /// Derived classes using this must call @c wait() in their destructor, before releasing any state used by
+  /// @p execute .
+  ///
+  /// @param execute The synchronous query implementation to run - typically a qualified call to @c onExecute() .
+  /// @return True if the query was started, false if a query is already running.
+  bool executeCpuAsync(const std::function<bool()> &execute);
+
+  /// Helper for implementing @c onExecuteAsync() on GPU. Call once the GPU work has been queued. Runs @p complete on a
+  /// background thread, invoking any @c CompletionFunction given to @c executeAsync() once it returns. @p complete
+  /// should block on the GPU completion event then collect the results, so completion is signalled by the GPU event
+  /// and @c wait() blocks on the event rather than polling it. Unlike @c executeCpuAsync() the current results are not
+  /// cleared.
+  ///
+  /// Derived classes using this must call @c wait() in their destructor, before releasing any state used by
+  /// @p complete .
+  ///
+  /// @param complete Function which awaits the GPU work and collects the results.
+  /// @return True if the completion was started, false if a query is already running.
+  bool completeAsync(const std::function<bool()> &complete);
+
+  /// Clear the query results without waiting for an asynchronous query. Used by @c reset() after waiting.
+  /// @param hard_reset True for a hard reset, false for a soft reset.
+  void resetResults(bool hard_reset);
+
   /// Called from @c reset(bool hardReset) to complete or terminate any
   /// outstanding asynchronous query and clear results.
   /// @param hard_reset True for a hard reset, false for a soft reset.
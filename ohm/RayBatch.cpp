@@ -0,0 +1,255 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RayBatch.h"
+
+#include "LineWalk.h"
+#include "MapChunk.h"
+#include "MapRegion.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "TaskArena.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <unordered_map>
+
+namespace ohm
+{
+RayBatch::RayBatch() = default;
+
+
+RayBatch::~RayBatch() = default;
+
+
+void RayBatch::clear()
+{
+  rays_.clear();
+  for (auto &ray_voxels : ray_voxels_)
+  {
+    ray_voxels.clear();
+  }
+  voxel_regions_.clear();
+  regions_.clear();
+  voxels_.clear();
+  region_nodes_.clear();
+}
+
+
+void RayBatch::reserve(size_t ray_count)
+{
+  rays_.reserve(ray_count);
+}
+
+
+void RayBatch::addRay(const glm::dvec3 &start, const glm::dvec3 &end, size_t source_index, unsigned walk_flags,
+                      unsigned batch_flags)
+{
+  rays_.emplace_back(RayBatchRay{ start, end, source_index, walk_flags, batch_flags });
+}
+
+
+void RayBatch::build(OccupancyMap &map, bool use_threads, double *last_exit_range)
+{
+  if (ray_voxels_.size() < rays_.size())
+  {
+    ray_voxels_.resize(rays_.size());
+  }
+
+  // Walk the rays to collect voxel updates.
+  const auto walk_ray = [this, &map](size_t ray_index)  //
+  {
+    const RayBatchRay &ray = rays_[ray_index];
+    std::vector<RayBatchVoxel> &ray_voxels = ray_voxels_[ray_index];
+    ray_voxels.clear();
+    if (ray.batch_flags & kRbWalk)
+    {
+      const auto visit_func = [&ray_voxels, ray_index](const Key &key, double enter_range,
+                                                       double exit_range) -> bool {
+        ray_voxels.emplace_back(RayBatchVoxel{ key, enter_range, exit_range, unsigned(ray_index), false });
+        return true;
+      };
+      walkSegmentKeys(LineWalkContext(map, visit_func), ray.start, ray.end, ray.walk_flags);
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    const auto walk_rays = [&walk_ray](const tbb::blocked_range<size_t> &range) {
+      for (size_t i = range.begin(); i < range.end(); ++i)
+      {
+        walk_ray(i);
+      }
+    };
+    parallelExecute([&]() { tbb::parallel_for(tbb::blocked_range<size_t>(0u, rays_.size()), walk_rays); });
+  }
+  else
+  {
+    for (size_t i = 0; i < rays_.size(); ++i)
+    {
+      walk_ray(i);
+    }
+  }
+#else   // OHM_FEATURE_THREADS
+  (void)use_threads;
+  for (size_t i = 0; i < rays_.size(); ++i)
+  {
+    walk_ray(i);
+  }
+#endif  // OHM_FEATURE_THREADS
+
+  // Assign regions for each voxel update in ray order, counting the updates per region.
+  std::unordered_map<glm::i16vec3, unsigned, MapRegion::Hash> region_lookup;
+  glm::i16vec3 last_region_key{ 0 };
+  unsigned last_region_index = ~0u;
+  const auto assign_region = [&](const Key &key)  //
+  {
+    if (last_region_index == ~0u || key.regionKey() != last_region_key)
+    {
+      const auto search = region_lookup.find(key.regionKey());
+      if (search != region_lookup.end())
+      {
+        last_region_index = search->second;
+      }
+      else
+      {
+        last_region_index = unsigned(regions_.size());
+        region_lookup.emplace(key.regionKey(), last_region_index);
+        regions_.emplace_back(RayBatchRegion{ key.regionKey(), nullptr, 0, 0 });
+      }
+      last_region_key = key.regionKey();
+    }
+    // Use voxel_end as a counter for now.
+    ++regions_[last_region_index].voxel_end;
+    voxel_regions_.emplace_back(last_region_index);
+  };
+
+  // Resolve the sample keys in one pass.
+  sample_points_.clear();
+  for (const RayBatchRay &ray : rays_)
+  {
+    if (ray.batch_flags & kRbSample)
+    {
+      sample_points_.emplace_back(ray.end);
+    }
+  }
+  sample_keys_.resize(sample_points_.size());
+  map.voxelKeys(sample_points_.data(), sample_points_.size(), sample_keys_.data());
+
+  double exit_range = (last_exit_range) ? *last_exit_range : 0.0;
+  size_t sample_index = 0;
+  for (size_t i = 0; i < rays_.size(); ++i)
+  {
+    const RayBatchRay &ray = rays_[i];
+    std::vector<RayBatchVoxel> &ray_voxels = ray_voxels_[i];
+    for (const RayBatchVoxel &voxel : ray_voxels)
+    {
+      assign_region(voxel.key);
+    }
+    exit_range = (!ray_voxels.empty()) ? ray_voxels.back().exit_range : exit_range;
+
+    if (ray.batch_flags & kRbSample)
+    {
+      const Key key = sample_keys_[sample_index++];
+      if (key.isNull())
+      {
+        // The sample lies outside the representable key range. Skip it as the line walk does for such rays.
+        continue;
+      }
+      ray_voxels.emplace_back(RayBatchVoxel{ key, exit_range, 0, unsigned(i), true });
+      assign_region(key);
+    }
+  }
+
+  if (last_exit_range)
+  {
+    *last_exit_range = exit_range;
+  }
+
+  // Convert counts to offsets.
+  size_t offset = 0;
+  for (RayBatchRegion &region : regions_)
+  {
+    const size_t count = region.voxel_end;
+    region.voxel_begin = region.voxel_end = offset;
+    offset += count;
+  }
+
+  // Resolve the chunks.
+  const unsigned numa_node_count = (numa_aware_ && use_threads) ? numaNodeCount() : 1u;
+  region_nodes_.clear();
+  if (numa_node_count > 1)
+  {
+    // Create the chunks on the region's node so the voxel memory is first touched there. Region creation is thread
+    // safe.
+    for (const RayBatchRegion &region : regions_)
+    {
+      region_nodes_.emplace_back(regionNumaNode(region.region_key, numa_node_count));
+    }
+    parallelForNuma(region_nodes_, [this, &map](size_t region_index) {
+      RayBatchRegion &region = regions_[region_index];
+      region.chunk = map.region(region.region_key, true);
+    });
+  }
+  else
+  {
+    for (RayBatchRegion &region : regions_)
+    {
+      region.chunk = map.region(region.region_key, true);
+    }
+  }
+
+  // Scatter the voxel updates into region order. Use voxel_end as the insertion point, which ends up at the correct
+  // position.
+  voxels_.resize(offset);
+  size_t voxel_index = 0;
+  for (size_t i = 0; i < rays_.size(); ++i)
+  {
+    for (const RayBatchVoxel &voxel : ray_voxels_[i])
+    {
+      RayBatchRegion &region = regions_[voxel_regions_[voxel_index++]];
+      voxels_[region.voxel_end++] = voxel;
+    }
+  }
+}
+
+
+void RayBatch::forEachRegion(const RegionFunction &func, bool use_threads) const
+{
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads && region_nodes_.size() == regions_.size() && !regions_.empty())
+  {
+    // NUMA placement from build(). Visit each region on its node.
+    parallelForNuma(region_nodes_, [this, &func](size_t region_index) {
+      const RayBatchRegion &region = regions_[region_index];
+      func(region, voxels_.data() + region.voxel_begin, region.voxel_end - region.voxel_begin);
+    });
+    return;
+  }
+
+  if (use_threads)
+  {
+    const auto visit_regions = [this, &func](const tbb::blocked_range<size_t> &range) {
+      for (size_t i = range.begin(); i < range.end(); ++i)
+      {
+        const RayBatchRegion &region = regions_[i];
+        func(region, voxels_.data() + region.voxel_begin, region.voxel_end - region.voxel_begin);
+      }
+    };
+    parallelExecute([&]() { tbb::parallel_for(tbb::blocked_range<size_t>(0u, regions_.size()), visit_regions); });
+    return;
+  }
+#endif  // OHM_FEATURE_THREADS
+  (void)use_threads;
+  for (const RayBatchRegion &region : regions_)
+  {
+    func(region, voxels_.data() + region.voxel_begin, region.voxel_end - region.voxel_begin);
+  }
+}
+}  // namespace ohm
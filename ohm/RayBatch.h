@@ -0,0 +1,182 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_RAYBATCH_H
+#define OHM_RAYBATCH_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+
+#include <glm/vec3.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct MapChunk;
+
+/// Flags controlling how a ray is added to a @c RayBatch via @c RayBatch::addRay() .
+enum RayBatchFlag : unsigned
+{
+  /// Walk the ray segment, generating a @c RayBatchVoxel for each voxel along the ray.
+  kRbWalk = (1u << 0u),
+  /// Generate a @c RayBatchVoxel for the sample voxel containing the end point of the ray. This is separate from
+  /// the ray walk with the sample voxel marked with @c RayBatchVoxel::sample . No update is generated when the end
+  /// point lies outside the range representable by a @c Key .
+  kRbSample = (1u << 1u)
+};
+
+/// A voxel update queued in a @c RayBatch .
+struct RayBatchVoxel
+{
+  /// Key of the voxel to update.
+  Key key;
+  /// Range at which the ray enters the voxel. For a sample voxel, this is the last exit range of the preceding ray
+  /// walk which is used for traversal calculations.
+  double enter_range;
+  /// Range at which the ray exits the voxel. Zero for a sample voxel.
+  double exit_range;
+  /// Index of the ray in the @c RayBatch which generated this update - see @c RayBatch::rays() .
+  unsigned ray_index;
+  /// True if this is the sample voxel update (@c kRbSample ) for the ray.
+  bool sample;
+};
+
+/// A ray added to a @c RayBatch .
+struct RayBatchRay
+{
+  /// Ray start point (post filter).
+  glm::dvec3 start;
+  /// Ray end point (post filter).
+  glm::dvec3 end;
+  /// Index of the ray in the source data, as specified in @c RayBatch::addRay() .
+  size_t source_index;
+  /// @c WalkKeyFlag values for walking the ray.
+  unsigned walk_flags;
+  /// @c RayBatchFlag values for the ray.
+  unsigned batch_flags;
+};
+
+/// A contiguous set of @c RayBatchVoxel updates which all fall in the same region.
+struct RayBatchRegion
+{
+  /// The region key.
+  glm::i16vec3 region_key;
+  /// The map chunk for the region. Resolved (and created) by @c RayBatch::build() .
+  MapChunk *chunk;
+  /// Index of the first @c RayBatchVoxel for this region in @c RayBatch::voxels() .
+  size_t voxel_begin;
+  /// One past the last @c RayBatchVoxel index for this region in @c RayBatch::voxels() .
+  size_t voxel_end;
+};
+
+/// A batching utility which sorts ray voxel updates by region for @c RayMapper implementations.
+///
+/// A naive @c RayMapper implementation walks each ray in turn and updates each voxel along the ray as it goes. This
+/// requires @c VoxelBuffer objects to be reloaded whenever consecutive voxels fall in a different @c MapChunk which
+/// may occur multiple times per ray. For spinning lidar, this thrashes between a few regions on every ray.
+///
+/// The @c RayBatch instead collects the rays and walks them as a batch, grouping the voxel updates by region while
+/// preserving the ray order of the updates within each region. A @c RayMapper may then visit each region once per
+/// batch - see @c forEachRegion() . So long as the update for each voxel depends only on that voxel's state and the
+/// ray, the results exactly match visiting the rays in order.
+///
+/// Typical usage is:
+/// - @c clear() the batch
+/// - call @c addRay() for each ray, with filtering and @c RayFlag logic already applied
+/// - @c build() the batch
+/// - process updates using @c forEachRegion()
+///
+/// Large ray sets should be processed in sub-batches of around @c kDefaultBatchSize rays to bound the memory
+/// overhead of the voxel update lists.
+class ohm_API RayBatch
+{
+public:
+  /// The recommended number of rays to process in a single batch.
+  static constexpr size_t kDefaultBatchSize = 2048u;
+
+  /// Function signature for @c forEachRegion() .
+  /// @param region The region being visited.
+  /// @param voxels The start of the @c RayBatchVoxel array for @p region - see @c RayBatchRegion::voxel_begin .
+  /// @param voxel_count The number of items in @p voxels .
+  using RegionFunction =
+    std::function<void(const RayBatchRegion &region, const RayBatchVoxel *voxels, size_t voxel_count)>;
+
+  /// Constructor.
+  RayBatch();
+  /// Destructor.
+  ~RayBatch();
+
+  /// Clear the batch content. Memory allocations are retained for reuse.
+  void clear();
+
+  /// Reserve memory for @p ray_count rays.
+  /// @param ray_count The number of rays to reserve for.
+  void reserve(size_t ray_count);
+
+  /// Add a ray to the batch. Rays are expected to already have any @c RayFilterFunction applied.
+  /// @param start The ray start point.
+  /// @param end The ray end point.
+  /// @param source_index Index of the ray in the source data - see @c RayBatchRay::source_index .
+  /// @param walk_flags @c WalkKeyFlag values used to walk the ray.
+  /// @param batch_flags @c RayBatchFlag values controlling which voxel updates are generated.
+  void addRay(const glm::dvec3 &start, const glm::dvec3 &end, size_t source_index, unsigned walk_flags,
+              unsigned batch_flags);
+
+  /// Build the batch for @p map , generating and grouping voxel updates by region. Also resolves the
+  /// @c RayBatchRegion::chunk for each region, creating the chunk as required.
+  ///
+  /// @param map The target map.
+  /// @param use_threads Walk the rays in parallel? Only used when built with @c OHM_FEATURE_THREADS .
+  /// @param[in,out] last_exit_range Optional exit range carried between batches. On input, this is the exit range
+  ///   used for a sample voxel when there has been no preceding ray walk. On output, this is the last exit range of
+  ///   this batch.
+  void build(OccupancyMap &map, bool use_threads = false, double *last_exit_range = nullptr);
+
+  /// Invoke @p func for each region in the batch. Regions may be visited in parallel when @p use_threads is set and
+  /// built with @c OHM_FEATURE_THREADS . Each region is visited by exactly one thread.
+  /// @param func The function to invoke.
+  /// @param use_threads Allow regions to be visited in parallel?
+  void forEachRegion(const RegionFunction &func, bool use_threads = false) const;
+
+  /// Enable NUMA aware placement for threaded @c build() and @c forEachRegion() calls.
+  ///
+  /// Regions are partitioned between the @c numaNodeCount() NUMA nodes by @c regionNumaNode() . Chunks are then
+  /// created by a worker on the region's node, so the voxel memory is first touched - and allocated by the operating
+  /// system - on that node, and each region is visited by a worker on the same node. Voxel memory recycled by the
+  /// @c VoxelMemoryPool may still originate from another node. Has no effect with a single NUMA node.
+  /// @param numa_aware True to enable NUMA aware placement.
+  inline void setNumaAware(bool numa_aware) { numa_aware_ = numa_aware; }
+  /// Query if NUMA aware placement is enabled. See @c setNumaAware() .
+  /// @return True if enabled.
+  inline bool numaAware() const { return numa_aware_; }
+
+  /// Query the rays in the batch.
+  /// @return The batch rays in the order they were added.
+  inline const std::vector<RayBatchRay> &rays() const { return rays_; }
+  /// Query the regions in the batch, available after @c build() .
+  /// @return The batch regions in the order they were first touched.
+  inline const std::vector<RayBatchRegion> &regions() const { return regions_; }
+  /// Query the batched voxel updates, available after @c build() . Items are grouped by region.
+  /// @return The voxel updates.
+  inline const std::vector<RayBatchVoxel> &voxels() const { return voxels_; }
+
+private:
+  std::vector<RayBatchRay> rays_;                        ///< Batch rays.
+  std::vector<std::vector<RayBatchVoxel>> ray_voxels_;  ///< Voxel updates for each ray before sorting.
+  std::vector<unsigned> voxel_regions_;                  ///< Region index for each voxel update before sorting.
+  std::vector<RayBatchRegion> regions_;                  ///< Batch regions.
+  std::vector<RayBatchVoxel> voxels_;                    ///< Voxel updates grouped by region.
+  std::vector<glm::dvec3> sample_points_;                ///< Sample points for the @c kRbSample rays.
+  std::vector<Key> sample_keys_;                         ///< Voxel keys for the @c sample_points_ .
+  std::vector<unsigned> region_nodes_;                   ///< NUMA node for each region. Only set with NUMA placement.
+  bool numa_aware_ = false;                              ///< Use NUMA aware placement? See @c setNumaAware() .
+};
+}  // namespace ohm
+
+#endif  // OHM_RAYBATCH_H
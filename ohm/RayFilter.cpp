@@ -7,8 +7,22 @@
 
 #include <Aabb.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace ohm
 {
+namespace
+{
+/// Check all components of @p v are finite. Uses non short circuit evaluation so the batch loops stay branch free.
+inline bool isFinite(const glm::dvec3 &v)
+{
+  return std::isfinite(v.x) & std::isfinite(v.y) & std::isfinite(v.z);
+}
+}  // namespace
+
+
 bool goodRay(const glm::dvec3 &start, const glm::dvec3 &end, double max_range)
 {
   bool is_good = true;
@@ -84,4 +98,91 @@ bool clipToBounds(glm::dvec3 * /*start*/, glm::dvec3 *end, unsigned *filter_flag
   *filter_flags |= !!(clipped)*kRffClippedEnd;  // NOLINT(hicpp-signed-bitwise)
   return true;
 }
+
+
+void goodRayBatchFilter(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, double max_range)
+{
+  const double max_range_sqr = (max_range > 0) ? max_range * max_range : std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    const glm::dvec3 start = rays[i * 2 + 0];
+    const glm::dvec3 end = rays[i * 2 + 1];
+    const glm::dvec3 ray = end - start;
+    const bool is_good = isFinite(start) & isFinite(end) & (glm::dot(ray, ray) <= max_range_sqr);
+    filter_flags[i] |= !is_good * kRffInvalid;
+  }
+}
+
+
+void clipRayBatchFilter(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, double max_length)
+{
+  const double max_length_sqr = (max_length > 0) ? max_length * max_length : std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    const glm::dvec3 start = rays[i * 2 + 0];
+    const glm::dvec3 end = rays[i * 2 + 1];
+    const glm::dvec3 ray = end - start;
+    const double ray_length_sqr = glm::dot(ray, ray);
+    const bool is_good = isFinite(start) & isFinite(end);
+    const bool clip = is_good & (ray_length_sqr > max_length_sqr);
+    // Select rather than branch on the clipped end point.
+    const double scale = (clip) ? max_length / std::sqrt(ray_length_sqr) : 1.0;
+    rays[i * 2 + 1] = (clip) ? start + ray * scale : end;
+    filter_flags[i] |= (clip * kRffClippedEnd) | (!is_good * kRffInvalid);
+  }
+}
+
+
+void clipBoundedBatch(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, const ohm::Aabb &clip_box)
+{
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    if (!clipBounded(&rays[i * 2 + 0], &rays[i * 2 + 1], &filter_flags[i], clip_box))
+    {
+      filter_flags[i] |= kRffInvalid;
+    }
+  }
+}
+
+
+void clipToBoundsBatch(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, const ohm::Aabb &clip_box)
+{
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    // Lint(KS): everything is unsigned.
+    filter_flags[i] |= !!clip_box.contains(rays[i * 2 + 1]) * kRffClippedEnd;  // NOLINT(hicpp-signed-bitwise)
+  }
+}
+
+
+size_t filterRays(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count,
+                  const RayBatchFilterFunction &batch_filter, const RayFilterFunction &ray_filter)
+{
+  std::fill(filter_flags, filter_flags + ray_count, 0u);
+  if (batch_filter)
+  {
+    batch_filter(rays, filter_flags, ray_count);
+  }
+  else if (ray_filter)
+  {
+    for (size_t i = 0; i < ray_count; ++i)
+    {
+      if (!ray_filter(&rays[i * 2 + 0], &rays[i * 2 + 1], &filter_flags[i]))
+      {
+        filter_flags[i] |= kRffInvalid;
+      }
+    }
+  }
+  else
+  {
+    return 0;
+  }
+
+  size_t culled_count = 0;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    culled_count += (filter_flags[i] & kRffInvalid) != 0;
+  }
+  return culled_count;
+}
 }  // namespace ohm
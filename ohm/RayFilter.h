@@ -10,6 +10,7 @@
 
 #include <glm/fwd.hpp>
 
+#include <cstddef>
 #include <functional>
 
 namespace ohm
@@ -44,6 +45,19 @@ enum RayFilterFlag
 /// @return True if the sample ray may be processed, false to skip this sample.
 using RayFilterFunction = std::function<bool(glm::dvec3 *, glm::dvec3 *, unsigned *)>;
 
+/// Function prototype used to filter a whole array of rays in a single pass for @c OccupancyMap::integrateRays() .
+///
+/// This is the batch equivalent of @c RayFilterFunction . Invoking the filter once per batch avoids an indirect call
+/// per ray, and allows the built in filters to run tight loops over the ray array which the compiler may vectorise.
+/// The resulting @c filter_flags act as a compaction mask: rays marked with @c kRffInvalid are culled. Rays may be
+/// modified in place following the same rules as for @c RayFilterFunction .
+///
+/// @param rays Array of origin/sample point pairs. There are `2 * ray_count` elements. May be modified.
+/// @param filter_flags Array of @c ray_count flags, one per ray, zero initialised by the caller. May be added to using
+///   flags from @c RayFilterFlag , setting @c kRffInvalid to cull a ray.
+/// @param ray_count The number of rays.
+using RayBatchFilterFunction = std::function<void(glm::dvec3 *, unsigned *, size_t)>;
+
 /// A helper function to validate a sample ray. Fails on rays which have start or end point as infinite or NaN or
 /// if the ray length exceeds @p max_range (skipped if @p max_range <= 0).
 /// @param start The sample ray start coordinate.
@@ -99,6 +113,55 @@ bool ohm_API clipBounded(glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_fl
 /// @return True
 bool ohm_API clipToBounds(glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags, const ohm::Aabb &clip_box);
 
+/// A @c RayBatchFilterFunction equivalent of @c goodRayFilter() . Sets @c kRffInvalid for rays with infinite or NaN
+/// points, or rays longer than @p max_range (skipped if @p max_range <= 0).
+///
+/// @param rays Array of origin/sample point pairs.
+/// @param filter_flags Array of flags, one per ray.
+/// @param ray_count The number of rays.
+/// @param max_range Optional maximum range limit for the rays.
+void ohm_API goodRayBatchFilter(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, double max_range);
+
+/// A @c RayBatchFilterFunction equivalent of @c clipRayFilter() .
+///
+/// @param rays Array of origin/sample point pairs. Sample points may be modified.
+/// @param filter_flags Array of flags, one per ray.
+/// @param ray_count The number of rays.
+/// @param max_length Maximum ray length. Longer rays are clipped and marked with @c kRffClippedEnd .
+void ohm_API clipRayBatchFilter(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, double max_length);
+
+/// A @c RayBatchFilterFunction equivalent of @c clipBounded() . Rays which do not intersect @p clip_box are marked
+/// @c kRffInvalid .
+///
+/// @param rays Array of origin/sample point pairs. May be modified.
+/// @param filter_flags Array of flags, one per ray.
+/// @param ray_count The number of rays.
+/// @param clip_box The axis aligned box to clip rays to.
+void ohm_API clipBoundedBatch(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, const ohm::Aabb &clip_box);
+
+/// A @c RayBatchFilterFunction equivalent of @c clipToBounds() .
+///
+/// @param rays Array of origin/sample point pairs. Not modified.
+/// @param filter_flags Array of flags, one per ray.
+/// @param ray_count The number of rays.
+/// @param clip_box Rays with sample points within this box are marked @c kRffClippedEnd .
+void ohm_API clipToBoundsBatch(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count, const ohm::Aabb &clip_box);
+
+/// Apply ray filtering to an array of rays as a single pass, before the rays are integrated.
+///
+/// The @p batch_filter is used when valid, otherwise @p ray_filter is invoked for each ray, marking the rays it
+/// rejects with @c kRffInvalid . The @p filter_flags are cleared first, so they are zero for all rays when neither
+/// filter is valid.
+///
+/// @param rays Array of origin/sample point pairs. May be modified.
+/// @param[out] filter_flags Array of @p ray_count flags, set to the resulting flags for each ray.
+/// @param ray_count The number of rays.
+/// @param batch_filter The preferred batch filter. May be empty.
+/// @param ray_filter The fallback per ray filter. May be empty.
+/// @return The number of rays marked @c kRffInvalid .
+size_t ohm_API filterRays(glm::dvec3 *rays, unsigned *filter_flags, size_t ray_count,
+                          const RayBatchFilterFunction &batch_filter, const RayFilterFunction &ray_filter);
+
 }  // namespace ohm
 
 #endif  // RAYFILTER_H
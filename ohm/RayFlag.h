@@ -53,6 +53,16 @@ enum RayFlag
   // This may be ignored by some algorithms, such as ray queries.
   kRfReverseWalk = (1u << 8u),
 
+  /// Bin the samples in each ray batch by voxel and make one aggregated hit update per voxel, rather than reading and
+  /// writing the voxel once per sample. This greatly reduces voxel writes for dense, near range samples.
+  ///
+  /// Each region applies its miss updates in ray order before the aggregated hit updates, so results may differ
+  /// slightly from the default, strictly ray ordered update. The @c VoxelMean is also quantised once per voxel rather
+  /// than once per sample.
+  ///
+  /// Only supported by the CPU occupancy update ( @c RayMapperOccupancy ). Ignored elsewhere.
+  kRfAggregateSamples = (1u << 9u),
+
   /// Internal use flag values start here (not to be set by user).
   kRfInternal = (1u << 16u),
   /// Marks that timestamps are available for GPU. This is an internal flag.
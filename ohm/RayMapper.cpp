@@ -5,9 +5,92 @@
 // Author: Kazys Stepanas
 #include "RayMapper.h"
 
+#include "CompactRays.h"
+#include "TransformSamplesCpu.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
 namespace ohm
 {
+namespace
+{
+/// Number of samples transformed and integrated at a time by @c RayMapper::integrateLocalSamples() .
+constexpr size_t kLocalSampleBatchSize = 65536u;
+/// Number of rays expanded and integrated at a time from compact ray representations.
+constexpr size_t kCompactRayBatchSize = 65536u;
+
+/// Expand compact rays in batches using @p expand and integrate them with @p mapper .
+template <typename Expand>
+size_t integrateCompactRays(RayMapper &mapper, size_t element_count, const float *intensities,
+                            const double *timestamps, unsigned ray_update_flags, const Expand &expand)
+{
+  std::vector<glm::dvec3> rays(std::min(element_count, 2 * kCompactRayBatchSize));
+  size_t processed_count = 0;
+  for (size_t begin = 0; begin + 1 < element_count; begin += 2 * kCompactRayBatchSize)
+  {
+    // Process whole rays only.
+    const size_t end = std::min(begin + 2 * kCompactRayBatchSize, element_count & ~size_t(1));
+    const size_t ray_offset = begin / 2;
+    expand(begin, end - begin, rays.data());
+    processed_count +=
+      mapper.integrateRays(rays.data(), end - begin, (intensities) ? intensities + ray_offset : nullptr,
+                           (timestamps) ? timestamps + ray_offset : nullptr, ray_update_flags);
+  }
+  return processed_count;
+}
+}  // namespace
+
 RayMapper::RayMapper() = default;
 
 RayMapper::~RayMapper() = default;
+
+
+size_t RayMapper::integrateRelativeRays(const glm::vec3 *relative_rays, size_t element_count,
+                                        const glm::dvec3 &origin, const float *intensities, const double *timestamps,
+                                        unsigned ray_update_flags)
+{
+  return integrateCompactRays(*this, element_count, intensities, timestamps, ray_update_flags,
+                              [&](size_t begin, size_t count, glm::dvec3 *rays) {
+                                expandRays(relative_rays + begin, count, origin, rays);
+                              });
+}
+
+
+size_t RayMapper::integrateQuantisedRays(const glm::i16vec3 *quantised_rays, size_t element_count,
+                                         const glm::dvec3 &origin, double quantisation, const float *intensities,
+                                         const double *timestamps, unsigned ray_update_flags)
+{
+  return integrateCompactRays(*this, element_count, intensities, timestamps, ray_update_flags,
+                              [&](size_t begin, size_t count, glm::dvec3 *rays) {
+                                expandRays(quantised_rays + begin, count, origin, quantisation, rays);
+                              });
+}
+
+
+size_t RayMapper::integrateLocalSamples(const LocalSamples &samples, const SensorTrajectory &trajectory,
+                                        unsigned ray_update_flags, double max_range)
+{
+  TransformSamplesCpu transformer;
+  std::vector<glm::dvec3> rays;
+  std::vector<double> timestamps;
+  std::vector<float> intensities;
+  size_t processed_count = 0;
+
+  for (size_t begin = 0; begin < samples.count; begin += kLocalSampleBatchSize)
+  {
+    const size_t end = std::min(begin + kLocalSampleBatchSize, samples.count);
+    const size_t ray_count =
+      transformer.transform(trajectory, samples, begin, end, rays, max_range, &timestamps, &intensities);
+    if (ray_count)
+    {
+      processed_count += integrateRays(rays.data(), rays.size(), (samples.intensities) ? intensities.data() : nullptr,
+                                       timestamps.data(), ray_update_flags);
+    }
+  }
+
+  return processed_count;
+}
 }  // namespace ohm
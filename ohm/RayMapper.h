@@ -11,10 +11,14 @@
 
 #include <glm/fwd.hpp>
 
+#include <limits>
+
 namespace ohm
 {
 class OccupancyMap;
 class KeyList;
+struct LocalSamples;
+struct SensorTrajectory;
 
 /// A @c RayMapper serves to provide a unified interface for integrating rays into an @c OccupancyMap .
 ///
@@ -62,6 +66,59 @@ public:
   {
     return integrateRays(rays, element_count, nullptr, nullptr, kRfDefault);
   }
+
+  /// Integrate single precision rays expressed relative to @p origin - see @ref compactrays .
+  ///
+  /// The default implementation expands the rays to global double precision in bounded batches and calls
+  /// @c integrateRays() . Implementations which natively use origin relative, single precision rays - such as GPU
+  /// mappers - may override this to avoid the conversion.
+  ///
+  /// @param relative_rays The array of start/end point pairs to integrate, relative to @p origin .
+  /// @param element_count The number of elements in @p relative_rays , which is twice the ray count.
+  /// @param origin The origin for @p relative_rays .
+  /// @param intensities Optional per ray intensities. See @c integrateRays() .
+  /// @param timestamps Optional per ray timestamps. See @c integrateRays() .
+  /// @param ray_update_flags @c RayFlag bitset used to modify the behaviour of this function.
+  /// @return The number of samples processed.
+  virtual size_t integrateRelativeRays(const glm::vec3 *relative_rays, size_t element_count, const glm::dvec3 &origin,
+                                       const float *intensities, const double *timestamps, unsigned ray_update_flags);
+
+  /// Integrate quantised rays expressed relative to @p origin - see @ref compactrays .
+  ///
+  /// The default implementation expands the rays to global double precision in bounded batches and calls
+  /// @c integrateRays() .
+  ///
+  /// @param quantised_rays The array of quantised start/end point pairs to integrate, relative to @p origin .
+  /// @param element_count The number of elements in @p quantised_rays , which is twice the ray count.
+  /// @param origin The origin for @p quantised_rays .
+  /// @param quantisation The quantisation step for @p quantised_rays .
+  /// @param intensities Optional per ray intensities. See @c integrateRays() .
+  /// @param timestamps Optional per ray timestamps. See @c integrateRays() .
+  /// @param ray_update_flags @c RayFlag bitset used to modify the behaviour of this function.
+  /// @return The number of samples processed.
+  virtual size_t integrateQuantisedRays(const glm::i16vec3 *quantised_rays, size_t element_count,
+                                        const glm::dvec3 &origin, double quantisation, const float *intensities,
+                                        const double *timestamps, unsigned ray_update_flags);
+
+  /// Integrate sensor frame @p samples with per sample timestamps, motion compensating each sample using the sensor
+  /// @p trajectory .
+  ///
+  /// The sensor origin and orientation for each sample is interpolated from the @p trajectory at the sample
+  /// timestamp (see @c TransformSamplesCpu ) and the resulting global rays are passed to @c integrateRays() . Samples
+  /// are processed in fixed size batches so the global ray intermediate remains bounded regardless of the number of
+  /// @p samples . Non finite samples and samples beyond @p max_range are skipped.
+  ///
+  /// Should only be called if @c validated() is true.
+  ///
+  /// @param samples The sensor frame samples, timestamps and optional intensities.
+  /// @param trajectory The sensor trajectory covering the sample timestamps. Samples outside the trajectory time
+  ///   range use the nearest trajectory end.
+  /// @param ray_update_flags @c RayFlag bitset used to modify the behaviour of this function.
+  /// @param max_range Maximum allowed sensor to sample distance. Longer samples are skipped.
+  /// @return The number of samples processed.
+  size_t integrateLocalSamples(const LocalSamples &samples, const SensorTrajectory &trajectory,
+                               unsigned ray_update_flags = kRfDefault,
+                               double max_range = std::numeric_limits<double>::infinity());
 };
 }  // namespace ohm
 
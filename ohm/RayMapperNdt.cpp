@@ -16,6 +16,7 @@
 #include "LineWalk.h"
 #include "MapLayer.h"
 #include "MapLayout.h"
+#include "Metrics.h"
 #include "NdtMap.h"
 #include "OccupancyMap.h"
 #include "RayFilter.h"
@@ -24,10 +25,28 @@
 #include "VoxelIncident.h"
 #include "VoxelTouchTime.h"
 
+#include <ohmutil/Profile.h>
+
+#include <algorithm>
+#include <array>
 #include <iostream>
 
 namespace ohm
 {
+namespace
+{
+/// Sample voxel state held while the voxel covariance update is pending in a @c CovarianceHitBatch lane.
+struct PendingNdtHit
+{
+  VoxelMean voxel_mean;     ///< Voxel mean before the update.
+  glm::dvec3 voxel_centre;  ///< Global voxel centre.
+  glm::dvec3 start;         ///< Ray start point.
+  glm::dvec3 sample;        ///< Sample point.
+  float initial_value;      ///< Occupancy value before the update.
+  unsigned voxel_index;     ///< Index of the voxel in the region.
+};
+}  // namespace
+
 RayMapperNdt::RayMapperNdt(NdtMap *map)
   : map_(map)
   , occupancy_layer_(map_->map().layout().occupancyLayer())
@@ -50,6 +69,7 @@ RayMapperNdt::RayMapperNdt(NdtMap *map)
   Voxel<const uint32_t> incident_normal_layer(map_ptr, incident_normal_layer_);
 
   occupancy_dim_ = (occupancy.isLayerValid()) ? occupancy.layerDim() : occupancy_dim_;
+  occupancy_order_ = (occupancy.isLayerValid()) ? occupancy.layerVoxelOrder() : occupancy_order_;
 
   // Validate we have occupancy, mean and covariance layers and their dimensions match.
   valid_ = occupancy.isLayerValid() && mean.isLayerValid() && cov.isLayerValid() &&
@@ -84,24 +104,15 @@ RayMapperNdt::~RayMapperNdt() = default;
 size_t RayMapperNdt::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
                                    const double *timestamps, unsigned ray_update_flags)
 {
-  KeyList keys;
-  MapChunk *last_chunk = nullptr;
-  VoxelBuffer<VoxelBlock> occupancy_buffer;
-  VoxelBuffer<VoxelBlock> mean_buffer;
-  VoxelBuffer<VoxelBlock> cov_buffer;
-  VoxelBuffer<VoxelBlock> intensity_buffer;
-  VoxelBuffer<VoxelBlock> hit_miss_count_buffer;
-  VoxelBuffer<VoxelBlock> traversal_buffer;
-  VoxelBuffer<VoxelBlock> touch_time_buffer;
-  VoxelBuffer<VoxelBlock> incidents_buffer;
+  PROFILE(RayMapperNdt_integrateRays);
   double last_exit_range = 0;
-  bool stop_adjustments = false;
 
   OccupancyMap &occupancy_map = map_->map();
   const RayFilterFunction ray_filter = occupancy_map.rayFilter();
   const bool use_filter = bool(ray_filter);
   const auto occupancy_layer = occupancy_layer_;
   const auto occupancy_dim = occupancy_dim_;
+  const auto occupancy_order = occupancy_order_;
   const auto miss_value = occupancy_map.missValue();
   const auto hit_value = occupancy_map.hitValue();
   const auto resolution = occupancy_map.resolution();
@@ -112,6 +123,9 @@ size_t RayMapperNdt::integrateRays(const glm::dvec3 *rays, size_t element_count,
   const auto sensor_noise = map_->sensorNoise();
   const auto ndt_adaptation_rate = map_->adaptationRate();
   const auto ndt_sample_threshold = map_->ndtSampleThreshold();
+  const bool single_precision_covariance = map_->singlePrecisionCovariance();
+  // Stop adjustments is not supported in NDT, but we keep the same function signatures as occupancy.
+  const bool stop_adjustments = false;
 
   // Mean and covariance layers must exists.
   const auto mean_layer = mean_layer_;
@@ -122,12 +136,17 @@ size_t RayMapperNdt::integrateRays(const glm::dvec3 *rays, size_t element_count,
   const auto intensity_layer = intensity_layer_;
   const auto hit_miss_count_layer = hit_miss_count_layer_;
 
+  if (element_count)
+  {
+    // Page out old regions and meet the memory budget before we start binding chunks, keeping regions around the
+    // sensor.
+    occupancy_map.updateRegionPaging(rays[0]);
+    occupancy_map.enforceMemoryBudget();
+  }
+
   // Touch the map to flag changes.
   const auto touch_stamp = occupancy_map.touch();
 
-  glm::dvec3 start;
-  glm::dvec3 sample;
-  float intensity = 0.0f;
   double time_base = 0;
 
   if (timestamps)
@@ -137,272 +156,311 @@ size_t RayMapperNdt::integrateRays(const glm::dvec3 *rays, size_t element_count,
   }
   time_base = occupancy_map.firstRayTime();
 
-  const auto visit_func = [&](const Key &key, double enter_range, double exit_range) -> bool  //
+  // Update the voxels in a single region. Buffers are loaded once per region.
+  const auto update_region = [&](const RayBatchRegion &region, const RayBatchVoxel *voxels, size_t voxel_count)  //
   {
-    //
-    // The update logic here is a little unclear as it tries to avoid outright branches.
-    // The intended logic is described as follows:
-    // 1. Select direct write or additive adjustment.
-    //    - Make a direct, non-additive adjustment if one of the following conditions are met:
-    //      - stop_adjustments is true
-    //      - the voxel is uncertain
-    //      - voxel is saturated
-    //    - Otherwise add to present value.
-    // 2. Select the value adjustment
-    //    - current_value if one of the following conditions are met:
-    //      - stop_adjustments is true (no longer making adjustments)
-    //    - miss_value otherwise
-    // 3. Calculate new value
-    // 4. Apply saturation logic: only min saturation relevant
-    //    -
-    MapChunk *chunk = (last_chunk && key.regionKey() == last_chunk->region.coord) ?
-                        last_chunk :
-                        occupancy_map.region(key.regionKey(), true);
-    if (chunk != last_chunk)
-    {
-      occupancy_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
-      mean_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[mean_layer]);
-      cov_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[covariance_layer]);
-      if (ndt_tm_)
-      {
-        // Intensity not required for miss update, but we need it in sync for the update later.
-        intensity_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[intensity_layer_]);
-        hit_miss_count_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[hit_miss_count_layer]);
-      }
-      if (traversal_layer >= 0)
-      {
-        traversal_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[traversal_layer]);
-      }
-      if (touch_time_layer_ >= 0 && timestamps)
-      {
-        // Touch time not required for miss update, but we need it in sync for the update later.
-        touch_time_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[touch_time_layer_]);
-      }
-      if (incident_normal_layer_ >= 0)
-      {
-        // Incidents not required for miss update, but we need it in sync for the update later.
-        incidents_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[incident_normal_layer_]);
-      }
-    }
-    last_chunk = chunk;
-    const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim);
-    float occupancy_value;
-    CovarianceVoxel cov;
-    VoxelMean voxel_mean;
-    occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
-    cov_buffer.readVoxel(voxel_index, &cov);
-    mean_buffer.readVoxel(voxel_index, &voxel_mean);
-    const glm::dvec3 mean =
-      subVoxelToLocalCoord<glm::dvec3>(voxel_mean.coord, resolution) + occupancy_map.voxelCentreGlobal(key);
-    const float initial_value = occupancy_value;
-    float adjusted_value = initial_value;
-
-    bool is_miss = false;
-    calculateMissNdt(&cov, &adjusted_value, &is_miss, start, sample, mean, voxel_mean.count, unobservedOccupancyValue(),
-                     miss_value, ndt_adaptation_rate, sensor_noise, ndt_sample_threshold);
-
+    MapChunk *chunk = region.chunk;
+    VoxelBuffer<VoxelBlock> occupancy_buffer(chunk->voxel_blocks[occupancy_layer]);
+    VoxelBuffer<VoxelBlock> mean_buffer(chunk->voxel_blocks[mean_layer]);
+    VoxelBuffer<VoxelBlock> cov_buffer(chunk->voxel_blocks[covariance_layer]);
+    VoxelBuffer<VoxelBlock> intensity_buffer;
+    VoxelBuffer<VoxelBlock> hit_miss_count_buffer;
+    VoxelBuffer<VoxelBlock> traversal_buffer;
+    VoxelBuffer<VoxelBlock> touch_time_buffer;
+    VoxelBuffer<VoxelBlock> incidents_buffer;
     if (ndt_tm_)
     {
-      // Note we don't need hit count in miss calculation.
-      HitMissCount hit_miss_count_voxel;
-      hit_miss_count_buffer.readVoxel(voxel_index, &hit_miss_count_voxel);
-      hit_miss_count_voxel.miss_count += (is_miss) ? 1u : 0u;
-      hit_miss_count_buffer.writeVoxel(voxel_index, hit_miss_count_voxel);
+      intensity_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[intensity_layer]);
+      hit_miss_count_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[hit_miss_count_layer]);
     }
-
-    occupancyAdjustDown(&occupancy_value, initial_value, adjusted_value, unobservedOccupancyValue(), voxel_min,
-                        saturation_min, saturation_max, stop_adjustments);
-    occupancy_buffer.writeVoxel(voxel_index, occupancy_value);
-
-    // Accumulate traversal
     if (traversal_layer >= 0)
     {
-      float traversal;
-      traversal_buffer.readVoxel(voxel_index, &traversal);
-      traversal += float(exit_range - enter_range);
-      traversal_buffer.writeVoxel(voxel_index, traversal);
+      traversal_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[traversal_layer]);
     }
-
-    // Lint(KS): The analyser takes some branches which are not possible in practice.
-    // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
-    chunk->updateFirstValid(voxel_index);
-
-    stop_adjustments = stop_adjustments;
-    chunk->dirty_stamp = touch_stamp;
-    // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
-    // not so much the sequencing. We really don't want to synchronise here.
-    chunk->touched_stamps[occupancy_layer].store(touch_stamp, std::memory_order_relaxed);
-    if (ndt_tm_)
+    if (touch_time_layer_ >= 0 && timestamps)
     {
-      chunk->touched_stamps[hit_miss_count_layer].store(touch_stamp, std::memory_order_relaxed);
+      touch_time_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[touch_time_layer_]);
     }
-
-    // Store last exit range for final traversal accumulation.
-    last_exit_range = exit_range;
-
-    return true;
-  };
-
-  unsigned filter_flags;
-  float min_int = std::numeric_limits<float>::max();
-  float max_int = 0.0f;
-  for (size_t i = 0; i < element_count; i += 2)
-  {
-    filter_flags = 0;
-    start = rays[i];
-    sample = rays[i + 1];
-    if (intensities)
+    if (incident_normal_layer_ >= 0)
     {
-      intensity = intensities[i >> 1];
+      incidents_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[incident_normal_layer_]);
     }
 
-    if (use_filter)
+    // Sample voxel covariance updates are collected in lanes of a CovarianceHitBatch and completed together. Each
+    // lane must target a different voxel and a voxel must not be updated again while it has a pending lane, so the
+    // pending hits are flushed whenever either condition would be violated. This preserves the per voxel update order.
+    CovarianceHitBatch hit_batch;
+    std::array<PendingNdtHit, kCovarianceBatchWidth> pending_hits;
+
+    const auto flush_hits = [&]()  //
     {
-      if (!ray_filter(&start, &sample, &filter_flags))
+      if (!hit_batch.count)
       {
-        // Bad ray.
-        continue;
+        return;
       }
-    }
 
-    // Explicit update of the end voxel if it's a sample, include in ray if clipped.
-    const bool include_sample_in_ray = (filter_flags & kRffClippedEnd) || (ray_update_flags & kRfEndPointAsFree);
-    unsigned walk_flags = (!include_sample_in_ray) ? kExcludeEndVoxel : 0u;
-    // Skip the start voxel according to ray_update_flags.
-    walk_flags |= (ray_update_flags & kRfExcludeOrigin) ? kExcludeStartVoxel : 0u;
+      calculateHitWithCovarianceBatch(hit_batch, hit_value, unobservedOccupancyValue(), float(resolution),
+                                      map_->reinitialiseCovarianceThreshold(), map_->reinitialiseCovariancePointCount(),
+                                      single_precision_covariance);
 
-    if (!(ray_update_flags & kRfExcludeRay))
-    {
-      stop_adjustments = false;
-      walkSegmentKeys(LineWalkContext(occupancy_map, visit_func), start, sample, walk_flags);
-    }
+      for (unsigned lane = 0; lane < hit_batch.count; ++lane)
+      {
+        PendingNdtHit &hit = pending_hits[lane];
+        float occupancy_value = hit.initial_value;
+        occupancyAdjustUp(&occupancy_value, hit.initial_value, hit_batch.voxel_value[lane], unobservedOccupancyValue(),
+                          voxel_max, saturation_min, saturation_max, stop_adjustments);
 
-    if (!stop_adjustments && !include_sample_in_ray)
+        CovarianceVoxel cov;
+        hit_batch.getCovariance(lane, &cov);
+
+        VoxelMean &voxel_mean = hit.voxel_mean;
+        voxel_mean.count = (!hit_batch.reset_mean[lane]) ? voxel_mean.count : 0;
+        voxel_mean.coord =
+          subVoxelUpdate(voxel_mean.coord, voxel_mean.count, hit.sample - hit.voxel_centre, resolution);
+        ++voxel_mean.count;
+
+        occupancy_buffer.writeVoxel(hit.voxel_index, occupancy_value);
+        cov_buffer.writeVoxel(hit.voxel_index, cov);
+        mean_buffer.writeVoxel(hit.voxel_index, voxel_mean);
+
+        if (incident_normal_layer_ >= 0)
+        {
+          unsigned packed_normal{};
+          incidents_buffer.readVoxel(hit.voxel_index, &packed_normal);
+          // Point count has already been incremented so subtract one to get the right calculation.s
+          packed_normal = updateIncidentNormal(packed_normal, hit.start - hit.sample, voxel_mean.count - 1);
+          incidents_buffer.writeVoxel(hit.voxel_index, packed_normal);
+        }
+      }
+
+      hit_batch.count = 0;
+    };
+
+    for (size_t v = 0; v < voxel_count; ++v)
     {
-      // Like the miss logic, we have similar obfuscation here to avoid branching. It's a little simpler though,
-      // because we do have a branch above, which will filter some of the conditions catered for in miss integration.
-      const ohm::Key key = occupancy_map.voxelKey(sample);
-      MapChunk *chunk = (last_chunk && key.regionKey() == last_chunk->region.coord) ?
-                          last_chunk :
-                          occupancy_map.region(key.regionKey(), true);
-      if (chunk != last_chunk)
+      const RayBatchVoxel &voxel = voxels[v];
+      const RayBatchRay &ray = batch_.rays()[voxel.ray_index];
+      const Key &key = voxel.key;
+      const glm::dvec3 &start = ray.start;
+      const glm::dvec3 &sample = ray.end;
+      const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim, occupancy_order);
+
+      for (unsigned lane = 0; lane < hit_batch.count; ++lane)
       {
-        occupancy_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
-        mean_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[mean_layer]);
-        cov_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[covariance_layer_]);
-        if (ndt_tm_)
+        if (pending_hits[lane].voxel_index == voxel_index)
         {
-          intensity_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[intensity_layer_]);
-          hit_miss_count_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[hit_miss_count_layer_]);
+          flush_hits();
+          break;
         }
-        if (traversal_layer_ >= 0)
+      }
+
+      if (!voxel.sample)
+      {
+        //
+        // The update logic here is a little unclear as it tries to avoid outright branches.
+        // The intended logic is described as follows:
+        // 1. Select direct write or additive adjustment.
+        //    - Make a direct, non-additive adjustment if one of the following conditions are met:
+        //      - stop_adjustments is true
+        //      - the voxel is uncertain
+        //      - voxel is saturated
+        //    - Otherwise add to present value.
+        // 2. Select the value adjustment
+        //    - current_value if one of the following conditions are met:
+        //      - stop_adjustments is true (no longer making adjustments)
+        //    - miss_value otherwise
+        // 3. Calculate new value
+        // 4. Apply saturation logic: only min saturation relevant
+        //    -
+        float occupancy_value;
+        CovarianceVoxel cov;
+        VoxelMean voxel_mean;
+        occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
+        cov_buffer.readVoxel(voxel_index, &cov);
+        mean_buffer.readVoxel(voxel_index, &voxel_mean);
+        const glm::dvec3 mean =
+          subVoxelToLocalCoord<glm::dvec3>(voxel_mean.coord, resolution) + occupancy_map.voxelCentreGlobal(key);
+        const float initial_value = occupancy_value;
+        float adjusted_value = initial_value;
+
+        bool is_miss = false;
+        calculateMissNdt(&cov, &adjusted_value, &is_miss, start, sample, mean, voxel_mean.count,
+                         unobservedOccupancyValue(), miss_value, ndt_adaptation_rate, sensor_noise,
+                         ndt_sample_threshold);
+
+        if (ndt_tm_)
         {
-          traversal_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[traversal_layer]);
+          // Note we don't need hit count in miss calculation.
+          HitMissCount hit_miss_count_voxel;
+          hit_miss_count_buffer.readVoxel(voxel_index, &hit_miss_count_voxel);
+          hit_miss_count_voxel.miss_count += (is_miss) ? 1u : 0u;
+          hit_miss_count_buffer.writeVoxel(voxel_index, hit_miss_count_voxel);
         }
-        if (touch_time_layer_ >= 0 && timestamps)
+
+        occupancyAdjustDown(&occupancy_value, initial_value, adjusted_value, unobservedOccupancyValue(), voxel_min,
+                            saturation_min, saturation_max, stop_adjustments);
+        occupancy_buffer.writeVoxel(voxel_index, occupancy_value);
+
+        // Accumulate traversal
+        if (traversal_layer >= 0)
         {
-          touch_time_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[touch_time_layer_]);
+          float traversal;
+          traversal_buffer.readVoxel(voxel_index, &traversal);
+          traversal += float(voxel.exit_range - voxel.enter_range);
+          traversal_buffer.writeVoxel(voxel_index, traversal);
         }
-        if (incident_normal_layer_ >= 0)
+
+        // Lint(KS): The analyser takes some branches which are not possible in practice.
+        // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
+        chunk->updateFirstValid(key.localKey(), occupancy_dim);
+
+        chunk->markDirty(touch_stamp);
+        // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
+        // not so much the sequencing. We really don't want to synchronise here.
+        chunk->touched_stamps[occupancy_layer].store(touch_stamp, std::memory_order_relaxed);
+        if (ndt_tm_)
         {
-          incidents_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[incident_normal_layer_]);
+          chunk->touched_stamps[hit_miss_count_layer].store(touch_stamp, std::memory_order_relaxed);
         }
       }
-      last_chunk = chunk;
-      const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim);
-      const glm::dvec3 voxel_centre = occupancy_map.voxelCentreGlobal(key);
-      float occupancy_value;
-      CovarianceVoxel cov;
-      VoxelMean voxel_mean;
-      occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
-      cov_buffer.readVoxel(voxel_index, &cov);
-      mean_buffer.readVoxel(voxel_index, &voxel_mean);
-      const glm::dvec3 mean = subVoxelToLocalCoord<glm::dvec3>(voxel_mean.coord, resolution) + voxel_centre;
-      const float initial_value = occupancy_value;
-      float adjusted_value = initial_value;
-
-      IntensityMeanCov intensity_voxel;
-      HitMissCount hit_miss_count_voxel;
-      if (ndt_tm_)
+      else
       {
-        intensity_buffer.readVoxel(voxel_index, &intensity_voxel);
-        hit_miss_count_buffer.readVoxel(voxel_index, &hit_miss_count_voxel);
+        // Like the miss logic, we have similar obfuscation here to avoid branching. It's a little simpler though,
+        // because the ray batch filters some of the conditions catered for in miss integration.
+        const glm::dvec3 voxel_centre = occupancy_map.voxelCentreGlobal(key);
+        const float intensity = (intensities) ? intensities[ray.source_index] : 0.0f;
+        float occupancy_value;
+        CovarianceVoxel cov;
+        VoxelMean voxel_mean;
+        occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
+        cov_buffer.readVoxel(voxel_index, &cov);
+        mean_buffer.readVoxel(voxel_index, &voxel_mean);
+        const glm::dvec3 mean = subVoxelToLocalCoord<glm::dvec3>(voxel_mean.coord, resolution) + voxel_centre;
+        const float initial_value = occupancy_value;
+        const float adjusted_value = initial_value;
+
+        IntensityMeanCov intensity_voxel;
+        HitMissCount hit_miss_count_voxel;
+        if (ndt_tm_)
+        {
+          intensity_buffer.readVoxel(voxel_index, &intensity_voxel);
+          hit_miss_count_buffer.readVoxel(voxel_index, &hit_miss_count_voxel);
+
+          const bool reinitialise_permeability_with_covariance = true;  // TODO: make a parameter of map
+          calculateHitMissUpdateOnHit(&cov, adjusted_value, &hit_miss_count_voxel, start, sample, mean,
+                                      voxel_mean.count, unobservedOccupancyValue(),
+                                      reinitialise_permeability_with_covariance, ndt_adaptation_rate, sensor_noise,
+                                      map_->reinitialiseCovarianceThreshold(), map_->reinitialiseCovariancePointCount(),
+                                      ndt_sample_threshold);
+
+          calculateIntensityUpdateOnHit(&intensity_voxel, adjusted_value, intensity,
+                                        map_->initialIntensityCovariance(), voxel_mean.count,
+                                        map_->reinitialiseCovarianceThreshold(),
+                                        map_->reinitialiseCovariancePointCount());
+        }
 
-        const bool reinitialise_permeability_with_covariance = true;  // TODO: make a parameter of map
-        calculateHitMissUpdateOnHit(&cov, adjusted_value, &hit_miss_count_voxel, start, sample, mean, voxel_mean.count,
-                                    unobservedOccupancyValue(), reinitialise_permeability_with_covariance,
-                                    ndt_adaptation_rate, sensor_noise, map_->reinitialiseCovarianceThreshold(),
-                                    map_->reinitialiseCovariancePointCount(), ndt_sample_threshold);
+        // Queue the covariance, occupancy and mean update. See flush_hits().
+        PendingNdtHit &hit = pending_hits[hit_batch.add(cov, initial_value, sample, mean, voxel_mean.count)];
+        hit.voxel_mean = voxel_mean;
+        hit.voxel_centre = voxel_centre;
+        hit.start = start;
+        hit.sample = sample;
+        hit.initial_value = initial_value;
+        hit.voxel_index = voxel_index;
 
-        calculateIntensityUpdateOnHit(&intensity_voxel, adjusted_value, intensity, map_->initialIntensityCovariance(),
-                                      voxel_mean.count, map_->reinitialiseCovarianceThreshold(),
-                                      map_->reinitialiseCovariancePointCount());
+        if (ndt_tm_)
+        {
+          intensity_buffer.writeVoxel(voxel_index, intensity_voxel);
+          hit_miss_count_buffer.writeVoxel(voxel_index, hit_miss_count_voxel);
+        }
 
-        min_int = std::fmin(min_int, intensity_voxel.intensity_mean);
-        max_int = std::fmax(max_int, intensity_voxel.intensity_mean);
-      }
+        // Accumulate traversal
+        if (traversal_layer >= 0)
+        {
+          float traversal;
+          traversal_buffer.readVoxel(voxel_index, &traversal);
+          // For sample voxels, enter_range holds the last exit range of the preceding ray walk.
+          traversal += float(glm::length(sample - start) - voxel.enter_range);
+          traversal_buffer.writeVoxel(voxel_index, traversal);
+        }
 
-      const bool reset_mean = calculateHitWithCovariance(
-        &cov, &adjusted_value, sample, mean, voxel_mean.count, hit_value, unobservedOccupancyValue(), float(resolution),
-        map_->reinitialiseCovarianceThreshold(), map_->reinitialiseCovariancePointCount());
-      occupancyAdjustUp(&occupancy_value, initial_value, adjusted_value, unobservedOccupancyValue(), voxel_max,
-                        saturation_min, saturation_max, stop_adjustments);
+        if (touch_time_layer_ >= 0 && timestamps)
+        {
+          const unsigned touch_time = encodeVoxelTouchTime(time_base, timestamps[ray.source_index]);
+          touch_time_buffer.writeVoxel(voxel_index, touch_time);
+        }
 
-      voxel_mean.count = (!reset_mean) ? voxel_mean.count : 0;
-      voxel_mean.coord = subVoxelUpdate(voxel_mean.coord, voxel_mean.count, sample - voxel_centre, resolution);
-      ++voxel_mean.count;
+        // Lint(KS): The analyser takes some branches which are not possible in practice.
+        // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
+        chunk->updateFirstValid(key.localKey(), occupancy_dim);
 
-      occupancy_buffer.writeVoxel(voxel_index, occupancy_value);
-      cov_buffer.writeVoxel(voxel_index, cov);
-      mean_buffer.writeVoxel(voxel_index, voxel_mean);
-      if (ndt_tm_)
-      {
-        intensity_buffer.writeVoxel(voxel_index, intensity_voxel);
-        hit_miss_count_buffer.writeVoxel(voxel_index, hit_miss_count_voxel);
-      }
+        chunk->markDirty(touch_stamp);
+        // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
+        // not so much the sequencing. We really don't want to synchronise here.
+        chunk->touched_stamps[occupancy_layer].store(touch_stamp, std::memory_order_relaxed);
+        chunk->touched_stamps[mean_layer].store(touch_stamp, std::memory_order_relaxed);
+        chunk->touched_stamps[covariance_layer].store(touch_stamp, std::memory_order_relaxed);
+        if (ndt_tm_)
+        {
+          chunk->touched_stamps[intensity_layer].store(touch_stamp, std::memory_order_relaxed);
+          chunk->touched_stamps[hit_miss_count_layer].store(touch_stamp, std::memory_order_relaxed);
+        }
 
-      // Accumulate traversal
-      if (traversal_layer >= 0)
-      {
-        float traversal;
-        traversal_buffer.readVoxel(voxel_index, &traversal);
-        traversal += float(glm::length(sample - start) - last_exit_range);
-        traversal_buffer.writeVoxel(voxel_index, traversal);
+        if (hit_batch.count == kCovarianceBatchWidth)
+        {
+          flush_hits();
+        }
       }
+    }
 
-      if (touch_time_layer_ >= 0 && timestamps)
-      {
-        const unsigned touch_time = encodeVoxelTouchTime(time_base, timestamps[i >> 1]);
-        touch_time_buffer.writeVoxel(voxel_index, touch_time);
-      }
+    flush_hits();
+  };
 
-      if (incident_normal_layer_ >= 0)
-      {
-        unsigned packed_normal{};
-        incidents_buffer.readVoxel(voxel_index, &packed_normal);
-        // Point count has already been incremented so subtract one to get the right calculation.s
-        packed_normal = updateIncidentNormal(packed_normal, start - sample, voxel_mean.count - 1);
-        incidents_buffer.writeVoxel(voxel_index, packed_normal);
-      }
+  glm::dvec3 start;
+  glm::dvec3 sample;
+  unsigned filter_flags;
+  const size_t ray_count = element_count / 2;
+  size_t filtered_count = 0;
+  for (size_t batch_start = 0; batch_start < ray_count; batch_start += RayBatch::kDefaultBatchSize)
+  {
+    const size_t batch_end = std::min(batch_start + RayBatch::kDefaultBatchSize, ray_count);
+    batch_.clear();
+    batch_.reserve(batch_end - batch_start);
+
+    for (size_t i = batch_start; i < batch_end; ++i)
+    {
+      filter_flags = 0;
+      start = rays[i * 2 + 0];
+      sample = rays[i * 2 + 1];
 
-      // Lint(KS): The analyser takes some branches which are not possible in practice.
-      // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
-      chunk->updateFirstValid(voxel_index);
-
-      chunk->dirty_stamp = touch_stamp;
-      // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
-      // not so much the sequencing. We really don't want to synchronise here.
-      chunk->touched_stamps[occupancy_layer].store(touch_stamp, std::memory_order_relaxed);
-      chunk->touched_stamps[mean_layer].store(touch_stamp, std::memory_order_relaxed);
-      chunk->touched_stamps[covariance_layer].store(touch_stamp, std::memory_order_relaxed);
-      if (ndt_tm_)
+      if (use_filter)
       {
-        chunk->touched_stamps[intensity_layer].store(touch_stamp, std::memory_order_relaxed);
-        chunk->touched_stamps[hit_miss_count_layer].store(touch_stamp, std::memory_order_relaxed);
+        if (!ray_filter(&start, &sample, &filter_flags))
+        {
+          // Bad ray.
+          ++filtered_count;
+          continue;
+        }
       }
+
+      // Explicit update of the end voxel if it's a sample, include in ray if clipped.
+      const bool include_sample_in_ray = (filter_flags & kRffClippedEnd) || (ray_update_flags & kRfEndPointAsFree);
+      unsigned walk_flags = (!include_sample_in_ray) ? kExcludeEndVoxel : 0u;
+      // Skip the start voxel according to ray_update_flags.
+      walk_flags |= (ray_update_flags & kRfExcludeOrigin) ? kExcludeStartVoxel : 0u;
+
+      unsigned batch_flags = (!(ray_update_flags & kRfExcludeRay)) ? kRbWalk : 0u;
+      batch_flags |= (!include_sample_in_ray) ? kRbSample : 0u;
+      batch_.addRay(start, sample, i, walk_flags, batch_flags);
     }
+
+    batch_.build(occupancy_map, false, &last_exit_range);
+    batch_.forEachRegion(update_region);
   }
 
-  return element_count / 2;
+  const metrics::CoreMetrics &core_metrics = metrics::coreMetrics();
+  core_metrics.rays_integrated.add(ray_count);
+  core_metrics.rays_filtered.add(filtered_count);
+  return ray_count;
 }
 }  // namespace ohm
@@ -7,8 +7,10 @@
 
 #include "OhmConfig.h"
 
+#include "RayBatch.h"
 #include "RayFlag.h"
 #include "RayMapper.h"
+#include "VoxelOrder.h"
 
 #include <glm/vec3.hpp>
 
@@ -21,10 +23,10 @@ class NdtMap;
 /// @c MayLayout::occupancyLayer() - float occupancy values - , @c MapLayout::meanLayer() - @c VoxelMean - and
 /// @c MapLayout::covarianceLayer() - @c CovarianceVoxel .
 ///
-/// The @c integrateRays() implementation performs a single threaded walk of the voxels to update and touches
-/// those voxels one at a time, updating their occupancy value. Occupancy values are updated using
-/// @c calculateMissNdt() for voxels the rays pass through and @c calculateHitWithCovariance() for the sample/end
-/// voxels. Sample voxels also have their @c CovarianceVoxel and @c VoxelMean layers updated.
+/// The @c integrateRays() implementation performs a single threaded walk of the voxels to update using a
+/// @c RayBatch and touches those voxels one region at a time, updating their occupancy value. Occupancy values are
+/// updated using @c calculateMissNdt() for voxels the rays pass through and @c calculateHitWithCovariance() for the
+/// sample/end voxels. Sample voxels also have their @c CovarianceVoxel and @c VoxelMean layers updated.
 ///
 /// For reference see:
 /// 3D Normal Distributions Transform Occupancy Maps: An Efficient Representation for Mapping in Dynamic Environments
@@ -78,8 +80,11 @@ protected:
   int incident_normal_layer_ = -1;  ///< Cache incident normal layer index.
   /// Cached occupancy layer voxel dimensions. Voxel mean and covariance layers must exactly match.
   glm::u8vec3 occupancy_dim_{ 0, 0, 0 };
+  /// Cached occupancy layer voxel order. Shared by all layers of matching dimensions.
+  VoxelOrder occupancy_order_ = VoxelOrder::kRowMajor;
   bool valid_ = false;  ///< Has layer validation passed?
   const bool ndt_tm_;   ///< Does map implement ndt-tm?
+  RayBatch batch_;      ///< Ray batching helper.
 };
 
 }  // namespace ohm
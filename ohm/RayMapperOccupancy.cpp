@@ -10,20 +10,595 @@
 #include "MapChunk.h"
 #include "MapLayer.h"
 #include "MapLayout.h"
+#include "Metrics.h"
 #include "OccupancyMap.h"
+#include "OccupancyState.h"
+#include "OccupancyTransform.h"
 #include "Voxel.h"
 #include "VoxelBuffer.h"
 #include "VoxelIncident.h"
 #include "VoxelMean.h"
 #include "VoxelOccupancy.h"
+#include "VoxelTouchIncident.h"
 #include "VoxelTouchTime.h"
 
 // TODO (KS): RayMapperOccupancy::lookupRays() is deprecated. Use RaysQuery for less code maintenance, but it creates
 // a poor dependency.
 #include "RaysQuery.h"
 
+#include <ohmutil/Profile.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <utility>
+#include <vector>
+
 namespace ohm
 {
+namespace
+{
+/// Voxel layer buffers for the @c MapChunk currently being updated by a @c RayMapperOccupancy .
+struct OccupancyChunkBuffers
+{
+  MapChunk *chunk = nullptr;
+  VoxelBuffer<VoxelBlock> occupancy;
+  VoxelBuffer<VoxelBlock> mean;
+  VoxelBuffer<VoxelBlock> traversal;
+  VoxelBuffer<VoxelBlock> touch_time;
+  VoxelBuffer<VoxelBlock> incidents;
+  VoxelBuffer<VoxelBlock> touch_incident;
+  VoxelBuffer<VoxelBlock> occupancy_state;
+  /// Was the occupancy state layer up to date when the chunk was bound? A stale state layer is updated without
+  /// advancing its stamp so that it remains stale - see @c occupancyStateStale() .
+  bool occupancy_state_current = false;
+  /// Keys of voxels which change occupancy type while bound to this chunk. Only populated when the
+  /// @c OccupancyUpdateParams::record_changes flag is set.
+  std::vector<Key> changed_keys;
+};
+}  // namespace
+
+/// Cached map and layer parameters used to update voxels in @c RayMapperOccupancy .
+struct RayMapperOccupancy::OccupancyUpdateParams
+{
+  int occupancy_layer = -1;
+  int mean_layer = -1;
+  int traversal_layer = -1;
+  /// Touch time layer index. Set to -1 when there are no timestamps to update with.
+  int touch_time_layer = -1;
+  int incident_normal_layer = -1;
+  /// Packed touch time and incident normal layer index. See @c VoxelTouchIncident .
+  int touch_incident_layer = -1;
+  /// Occupancy state layer index. Set to -1 when the map has no valid state layer.
+  int occupancy_state_layer = -1;
+  glm::u8vec3 occupancy_dim{ 0, 0, 0 };
+  VoxelOrder occupancy_order = VoxelOrder::kRowMajor;
+  glm::u8vec3 occupancy_state_dim{ 0, 0, 0 };
+  VoxelOrder occupancy_state_order = VoxelOrder::kRowMajor;
+  float occupancy_threshold_value = 0;
+  float miss_value = 0;
+  float hit_value = 0;
+  float voxel_min = 0;
+  float voxel_max = 0;
+  float saturation_min = 0;
+  float saturation_max = 0;
+  double resolution = 0;
+  double time_base = 0;
+  /// Occupancy decay time constant. See @c OccupancyMap::occupancyDecayTime() . Only used with a valid
+  /// @c touch_time_layer .
+  double decay_time = 0;
+  /// The time to decay voxels to before updating them. The latest timestamp of the update.
+  double update_time = 0;
+  /// Encoded @c update_time written as the touch time of decayed voxels. See @c encodeVoxelTouchTime() .
+  unsigned update_touch_time = 0;
+  uint64_t touch_stamp = 0;
+  unsigned ray_update_flags = 0;
+  /// Update the touch time in the @c touch_incident_layer ? Only set when there are timestamps to update with.
+  bool touch_incident_time = false;
+  /// Record voxels which change occupancy type in @c OccupancyChunkBuffers::changed_keys ?
+  bool record_changes = false;
+};
+
+namespace
+{
+using OccupancyUpdateParams = RayMapperOccupancy::OccupancyUpdateParams;
+
+/// Optional layer updates made by @c RayMapperOccupancy . The voxel update functions are instantiated for each
+/// combination of these flags so the per voxel layer selection is resolved at compile time.
+enum OccupancyUpdateFeature : unsigned
+{
+  kOufMean = (1u << 0u),             ///< Update @c OccupancyUpdateParams::mean_layer .
+  kOufTraversal = (1u << 1u),        ///< Update @c OccupancyUpdateParams::traversal_layer .
+  kOufTouchTime = (1u << 2u),        ///< Update @c OccupancyUpdateParams::touch_time_layer .
+  kOufIncidentNormal = (1u << 3u),   ///< Update @c OccupancyUpdateParams::incident_normal_layer .
+  kOufTouchIncident = (1u << 4u),    ///< Update @c OccupancyUpdateParams::touch_incident_layer .
+  kOufOccupancyState = (1u << 5u),   ///< Update @c OccupancyUpdateParams::occupancy_state_layer .
+  kOufDecay = (1u << 6u),            ///< Lazy decay by @c OccupancyUpdateParams::decay_time . Implies kOufTouchTime.
+  kOufCombinations = (1u << 7u)      ///< Number of feature combinations.
+};
+
+
+/// Resolve the @c OccupancyUpdateFeature flags for @p params .
+unsigned occupancyUpdateFeatures(const OccupancyUpdateParams &params)
+{
+  unsigned features = 0;
+  features |= (params.mean_layer >= 0) ? kOufMean : 0u;
+  features |= (params.traversal_layer >= 0) ? kOufTraversal : 0u;
+  features |= (params.touch_time_layer >= 0) ? kOufTouchTime : 0u;
+  features |= (params.incident_normal_layer >= 0) ? kOufIncidentNormal : 0u;
+  features |= (params.touch_incident_layer >= 0) ? kOufTouchIncident : 0u;
+  features |= (params.occupancy_state_layer >= 0) ? kOufOccupancyState : 0u;
+  features |= (params.touch_time_layer >= 0 && params.decay_time > 0) ? kOufDecay : 0u;
+  return features;
+}
+
+/// Bind the layer @p buffers to reference @p chunk . Does nothing if @p chunk is already bound.
+void bindChunk(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, MapChunk *chunk)
+{
+  if (chunk == buffers.chunk)
+  {
+    return;
+  }
+
+  buffers.chunk = chunk;
+  buffers.occupancy = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.occupancy_layer]);
+  if (params.traversal_layer >= 0)
+  {
+    buffers.traversal = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.traversal_layer]);
+  }
+  if (params.touch_time_layer >= 0)
+  {
+    // Touch time not required for miss update, but we need it in sync for the update later.
+    buffers.touch_time = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.touch_time_layer]);
+  }
+  if (params.incident_normal_layer >= 0)
+  {
+    // Incidents not required for miss update, but we need it in sync for the update later.
+    buffers.incidents = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.incident_normal_layer]);
+  }
+  if (params.touch_incident_layer >= 0)
+  {
+    buffers.touch_incident = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.touch_incident_layer]);
+  }
+  if (params.occupancy_state_layer >= 0)
+  {
+    buffers.occupancy_state = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.occupancy_state_layer]);
+    buffers.occupancy_state_current =
+      !occupancyStateStale(*chunk, params.occupancy_layer, params.occupancy_state_layer);
+  }
+  // The mean layer is only required for sample updates and is bound on demand.
+  buffers.mean.release();
+}
+
+
+/// @overload
+void bindChunk(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, OccupancyMap &map,
+               const glm::i16vec3 &region_key)
+{
+  if (!buffers.chunk || region_key != buffers.chunk->region.coord)
+  {
+    bindChunk(buffers, params, map.region(region_key, true));
+  }
+}
+
+
+/// Record @p key in @p buffers if the voxel occupancy type changes with an update from @p initial_value to
+/// @p final_value . Only the transitions between being observed, and between being occupied are considered.
+void recordOccupancyChange(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, const Key &key,
+                           float initial_value, float final_value)
+{
+  if (!params.record_changes)
+  {
+    return;
+  }
+
+  const bool initially_unobserved = initial_value == unobservedOccupancyValue();
+  const bool finally_unobserved = final_value == unobservedOccupancyValue();
+  const bool initially_occupied = !initially_unobserved && initial_value >= params.occupancy_threshold_value;
+  const bool finally_occupied = !finally_unobserved && final_value >= params.occupancy_threshold_value;
+  if (initially_unobserved != finally_unobserved || initially_occupied != finally_occupied)
+  {
+    buffers.changed_keys.emplace_back(key);
+  }
+}
+
+
+/// Update the occupancy state layer for the voxel at @p key to reflect its new @p occupancy_value . Does nothing
+/// without @c kOufOccupancyState .
+template <unsigned kFeatures>
+void updateOccupancyStateVoxel(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, const Key &key,
+                               float occupancy_value)
+{
+  if (!(kFeatures & kOufOccupancyState))
+  {
+    return;
+  }
+
+  const unsigned state_index =
+    ohm::voxelIndex(key.localKey() / uint8_t(2), params.occupancy_state_dim, params.occupancy_state_order);
+  uint16_t packed = 0;
+  buffers.occupancy_state.readVoxel(state_index, &packed);
+  packed = packOccupancyState(packed, key.localKey(),
+                              occupancyStateFromValue(occupancy_value, params.occupancy_threshold_value));
+  buffers.occupancy_state.writeVoxel(state_index, packed);
+  if (buffers.occupancy_state_current)
+  {
+    buffers.chunk->touched_stamps[params.occupancy_state_layer].store(params.touch_stamp, std::memory_order_relaxed);
+  }
+}
+
+
+/// Decay the @p occupancy_value of the voxel at @p voxel_index to the @c OccupancyUpdateParams::update_time based on
+/// its touch time. Does nothing without @c kOufDecay .
+template <unsigned kFeatures>
+float decayOccupancyVoxel(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, unsigned voxel_index,
+                          float occupancy_value)
+{
+  if (!(kFeatures & kOufDecay))
+  {
+    return occupancy_value;
+  }
+
+  unsigned touch_time = 0;
+  buffers.touch_time.readVoxel(voxel_index, &touch_time);
+  const double elapsed = params.update_time - decodeVoxelTouchTime(params.time_base, touch_time);
+  return decayedOccupancyValue(occupancy_value, elapsed, params.decay_time, params.saturation_min,
+                               params.saturation_max);
+}
+
+
+/// Apply a miss update to the voxel at @p key in the chunk bound to @p buffers .
+/// @tparam kFeatures The @c OccupancyUpdateFeature flags matching @p params .
+/// @return True if the voxel was occupied before the update.
+template <unsigned kFeatures>
+bool integrateMissVoxel(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, const Key &key,
+                        double enter_range, double exit_range, bool stop_adjustments)
+{
+  const unsigned voxel_index = ohm::voxelIndex(key, params.occupancy_dim, params.occupancy_order);
+  // The update logic here is a little unclear as it tries to avoid outright branches.
+  // The intended logic is described as follows:
+  // 1. Select direct write or additive adjustment.
+  //    - Make a direct, non-additive adjustment if one of the following conditions are met:
+  //      - stop_adjustments is true
+  //      - the voxel is uncertain
+  //      - ray_update_flags and kRfExclude<Type> flags pass.
+  //      - voxel is saturated
+  //    - Otherwise add to present value.
+  // 2. Select the value adjustment
+  //    - current_value if one of the following conditions are met:
+  //      - stop_adjustments is true (no longer making adjustments)
+  //      - ray_update_flags and kRfExclude<Type> flags pass.
+  //    - miss_value otherwise
+  // 3. Calculate new value
+  // 4. Apply saturation logic: only min saturation relevant
+  //    -
+  const unsigned ray_update_flags = params.ray_update_flags;
+  MapChunk *chunk = buffers.chunk;
+  float occupancy_value;
+  buffers.occupancy.readVoxel(voxel_index, &occupancy_value);
+  const float stored_value = occupancy_value;
+  const float initial_value = decayOccupancyVoxel<kFeatures>(buffers, params, voxel_index, stored_value);
+  occupancy_value = initial_value;
+
+  const bool initially_unobserved = initial_value == unobservedOccupancyValue();
+  const bool initially_free = !initially_unobserved && initial_value < params.occupancy_threshold_value;
+  const bool initially_occupied = !initially_unobserved && initial_value >= params.occupancy_threshold_value;
+
+  // Calculate the adjustment to make based on the initial occupancy value, various exclusion flags and the configured
+  // value adjustment.
+  float miss_adjustment = params.miss_value;
+  // The next series of statements are designed to modify the miss_adjustment according to the current voxel state
+  // and the kRfExclude<Type> values. Note that for kRfExcludeUnobserved we set the miss_adjustment such that it keeps
+  // the observesed value, whereas in other cases we set to zero to make for no change. This is because unobserved
+  // values have a value written, whereas other voxels have use addition to adjust the value.
+  miss_adjustment = (initially_unobserved && (ray_update_flags & kRfExcludeUnobserved)) ? unobservedOccupancyValue() :
+                                                                                          miss_adjustment;
+  miss_adjustment = (initially_free && (ray_update_flags & kRfExcludeFree)) ? 0.0f : miss_adjustment;
+  miss_adjustment = (initially_occupied && (ray_update_flags & kRfExcludeOccupied)) ? 0.0f : miss_adjustment;
+
+  occupancyAdjustMiss(&occupancy_value, initial_value, miss_adjustment, unobservedOccupancyValue(), params.voxel_min,
+                      params.saturation_min, params.saturation_max, stop_adjustments);
+  buffers.occupancy.writeVoxel(voxel_index, occupancy_value);
+  updateOccupancyStateVoxel<kFeatures>(buffers, params, key, occupancy_value);
+  recordOccupancyChange(buffers, params, key, stored_value, occupancy_value);
+
+  if ((kFeatures & kOufDecay) && occupancy_value != unobservedOccupancyValue())
+  {
+    // The value is now current as of the update time. Without this the decay would be applied again next update.
+    buffers.touch_time.writeVoxel(voxel_index, params.update_touch_time);
+  }
+
+  // Accumulate traversal
+  if (kFeatures & kOufTraversal)
+  {
+    float traversal;
+    buffers.traversal.readVoxel(voxel_index, &traversal);
+    traversal += float(exit_range - enter_range);
+    buffers.traversal.writeVoxel(voxel_index, traversal);
+  }
+
+  // Lint(KS): The analyser takes some branches which are not possible in practice.
+  // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
+  chunk->updateFirstValid(key.localKey(), params.occupancy_dim);
+
+  chunk->markDirty(params.touch_stamp);
+  // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
+  // not so much the sequencing. We really don't want to synchronise here.
+  chunk->touched_stamps[params.occupancy_layer].store(params.touch_stamp, std::memory_order_relaxed);
+
+  return initially_occupied;
+}
+
+
+/// A sample to integrate as a hit in @c integrateHitVoxel() .
+struct HitSample
+{
+  glm::dvec3 start;        ///< Ray origin.
+  glm::dvec3 end;          ///< Sample point.
+  double last_exit_range;  ///< Exit range of the last voxel walked for the ray. Used for traversal.
+  double timestamp;        ///< Sample timestamp. Zero when there are no timestamps.
+};
+
+
+/// Apply hit updates for all the @p samples falling in the voxel at @p key in the chunk bound to @p buffers .
+///
+/// Each sample adjusts the occupancy value as a separate hit, exactly as for sequential single sample updates. Other
+/// layers are updated with one read and write per voxel and the @c VoxelMean is updated in one step via a
+/// @c VoxelMeanAccumulator . The touch time is taken from the last sample.
+/// @tparam kFeatures The @c OccupancyUpdateFeature flags matching @p params .
+template <unsigned kFeatures>
+void integrateHitVoxel(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, const OccupancyMap &map,
+                       const Key &key, const HitSample *samples, size_t sample_count)
+{
+  // Like the miss logic, we have similar obfuscation here to avoid branching. It's a little simpler though,
+  // because we do have a branch in the caller, which will filter some of the conditions catered for in miss
+  // integration.
+  const unsigned ray_update_flags = params.ray_update_flags;
+  MapChunk *chunk = buffers.chunk;
+  const unsigned voxel_index = ohm::voxelIndex(key, params.occupancy_dim, params.occupancy_order);
+
+  float occupancy_value;
+  buffers.occupancy.readVoxel(voxel_index, &occupancy_value);
+  const float initial_value = occupancy_value;
+  occupancy_value = decayOccupancyVoxel<kFeatures>(buffers, params, voxel_index, occupancy_value);
+
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    const float sample_initial_value = occupancy_value;
+    const bool initially_unobserved = sample_initial_value == unobservedOccupancyValue();
+    const bool initially_free = !initially_unobserved && sample_initial_value < params.occupancy_threshold_value;
+    const bool initially_occupied = !initially_unobserved && sample_initial_value >= params.occupancy_threshold_value;
+
+    // Calculate the adjustment to make based on the initial occupancy value, various exclusion flags and the
+    // configured value adjustment (see the equivalent section for the miss update). Note the adjustment for skipping
+    // an initially_unobserved voxel is not zero - it's unobservedOccupancyValue()/infinity to keep the state
+    // unchanged.
+    float hit_adjustment = params.hit_value;
+    hit_adjustment =
+      (initially_unobserved && (ray_update_flags & kRfExcludeUnobserved)) ? unobservedOccupancyValue() : hit_adjustment;
+    hit_adjustment = (initially_free && (ray_update_flags & kRfExcludeFree)) ? 0.0f : hit_adjustment;
+    hit_adjustment = (initially_occupied && (ray_update_flags & kRfExcludeOccupied)) ? 0.0f : hit_adjustment;
+
+    occupancyAdjustHit(&occupancy_value, sample_initial_value, hit_adjustment, unobservedOccupancyValue(),
+                       params.voxel_max, params.saturation_min, params.saturation_max, false);
+  }
+
+  // update voxel mean if present.
+  unsigned sample_count_base = 0;
+  if (kFeatures & kOufMean)
+  {
+    if (!buffers.mean.isValid())
+    {
+      buffers.mean = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[params.mean_layer]);
+    }
+    VoxelMean voxel_mean;
+    buffers.mean.readVoxel(voxel_index, &voxel_mean);
+    sample_count_base = voxel_mean.count;
+    if (sample_count == 1)
+    {
+      voxel_mean.coord =
+        subVoxelUpdate(voxel_mean.coord, voxel_mean.count, samples[0].end - map.voxelCentreGlobal(key),
+                       params.resolution);
+      ++voxel_mean.count;
+    }
+    else
+    {
+      const glm::dvec3 voxel_centre = map.voxelCentreGlobal(key);
+      VoxelMeanAccumulator accumulator;
+      for (size_t i = 0; i < sample_count; ++i)
+      {
+        accumulator.add(samples[i].end, voxel_centre);
+      }
+      updatePosition(&voxel_mean, accumulator, params.resolution);
+    }
+    buffers.mean.writeVoxel(voxel_index, voxel_mean);
+    // Lint(KS): The analyser takes some branches which are not possible in practice.
+    // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
+    chunk->touched_stamps[params.mean_layer].store(params.touch_stamp, std::memory_order_relaxed);
+  }
+  buffers.occupancy.writeVoxel(voxel_index, occupancy_value);
+  updateOccupancyStateVoxel<kFeatures>(buffers, params, key, occupancy_value);
+  recordOccupancyChange(buffers, params, key, initial_value, occupancy_value);
+
+  // The incident normal weighting uses the mean sample count, which only advances with a mean layer.
+  const unsigned sample_count_step = (kFeatures & kOufMean) ? 1u : 0u;
+
+  // Accumulate traversal
+  if (kFeatures & kOufTraversal)
+  {
+    float traversal;
+    buffers.traversal.readVoxel(voxel_index, &traversal);
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+      traversal += float(glm::length(samples[i].end - samples[i].start) - samples[i].last_exit_range);
+    }
+    buffers.traversal.writeVoxel(voxel_index, traversal);
+  }
+
+  if (kFeatures & kOufTouchTime)
+  {
+    // With decay the value is current as of the update time, which may be later than the last sample.
+    const unsigned touch_time = (kFeatures & kOufDecay) ?
+                                  params.update_touch_time :
+                                  encodeVoxelTouchTime(params.time_base, samples[sample_count - 1].timestamp);
+    buffers.touch_time.writeVoxel(voxel_index, touch_time);
+  }
+
+  if (kFeatures & kOufIncidentNormal)
+  {
+    unsigned packed_normal{};
+    buffers.incidents.readVoxel(voxel_index, &packed_normal);
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+      packed_normal = updateIncidentNormal(packed_normal, samples[i].start - samples[i].end,
+                                           sample_count_base + unsigned(i) * sample_count_step);
+    }
+    buffers.incidents.writeVoxel(voxel_index, packed_normal);
+  }
+
+  if (kFeatures & kOufTouchIncident)
+  {
+    // Packed layer: update touch time and incident normal with a single read and write.
+    VoxelTouchIncident touch_incident{};
+    buffers.touch_incident.readVoxel(voxel_index, &touch_incident);
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+      updateTouchIncident(&touch_incident, samples[i].start - samples[i].end,
+                          sample_count_base + unsigned(i) * sample_count_step,
+                          (params.touch_incident_time) ? encodeVoxelTouchTime(params.time_base, samples[i].timestamp) :
+                                                         0u,
+                          params.touch_incident_time);
+    }
+    buffers.touch_incident.writeVoxel(voxel_index, touch_incident);
+  }
+
+  // Lint(KS): The analyser takes some branches which are not possible in practice.
+  // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
+  chunk->updateFirstValid(key.localKey(), params.occupancy_dim);
+
+  chunk->markDirty(params.touch_stamp);
+  // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
+  // not so much the sequencing. We really don't want to synchronise here.
+  chunk->touched_stamps[params.occupancy_layer].store(params.touch_stamp, std::memory_order_relaxed);
+}
+
+
+/// Apply a hit update to the voxel at @p key in the chunk bound to @p buffers for the ray @p start to @p end .
+template <unsigned kFeatures>
+void integrateHitVoxel(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, const OccupancyMap &map,
+                       const Key &key, const glm::dvec3 &start, const glm::dvec3 &end, double last_exit_range,
+                       double timestamp)
+{
+  const HitSample sample{ start, end, last_exit_range, timestamp };
+  integrateHitVoxel<kFeatures>(buffers, params, map, key, &sample, 1);
+}
+
+
+/// Apply the @p voxels updates from a @c RayBatch to the chunk bound to @p buffers .
+/// @tparam kFeatures The @c OccupancyUpdateFeature flags matching @p params .
+/// @param buffers Layer buffers bound to the region chunk.
+/// @param params Cached update parameters.
+/// @param map The map being updated.
+/// @param rays The @c RayBatch::rays() .
+/// @param timestamps Optional per ray timestamps, indexed by @c RayBatchRay::source_index .
+/// @param voxels The voxel updates for the region.
+/// @param voxel_count Number of @p voxels .
+template <unsigned kFeatures>
+void integrateRegion(OccupancyChunkBuffers &buffers, const OccupancyUpdateParams &params, const OccupancyMap &map,
+                     const RayBatchRay *rays, const double *timestamps, const RayBatchVoxel *voxels,
+                     size_t voxel_count)
+{
+  if (!(params.ray_update_flags & kRfAggregateSamples))
+  {
+    for (size_t i = 0; i < voxel_count; ++i)
+    {
+      const RayBatchVoxel &voxel = voxels[i];
+      if (!voxel.sample)
+      {
+        integrateMissVoxel<kFeatures>(buffers, params, voxel.key, voxel.enter_range, voxel.exit_range, false);
+      }
+      else
+      {
+        const RayBatchRay &ray = rays[voxel.ray_index];
+        integrateHitVoxel<kFeatures>(buffers, params, map, voxel.key, ray.start, ray.end, voxel.enter_range,
+                                     (timestamps) ? timestamps[ray.source_index] : 0);
+      }
+    }
+    return;
+  }
+
+  // Apply the misses in ray order, binning the samples by voxel index. Pairs of (voxel index, batch index) sort by
+  // voxel while keeping the ray order within each voxel.
+  std::vector<std::pair<unsigned, size_t>> sample_bins;
+  for (size_t i = 0; i < voxel_count; ++i)
+  {
+    const RayBatchVoxel &voxel = voxels[i];
+    if (!voxel.sample)
+    {
+      integrateMissVoxel<kFeatures>(buffers, params, voxel.key, voxel.enter_range, voxel.exit_range, false);
+    }
+    else
+    {
+      sample_bins.emplace_back(ohm::voxelIndex(voxel.key, params.occupancy_dim, params.occupancy_order), i);
+    }
+  }
+
+  std::sort(sample_bins.begin(), sample_bins.end());
+
+  // Make one aggregated hit update per voxel.
+  std::vector<HitSample> hit_samples;
+  for (size_t bin_start = 0; bin_start < sample_bins.size();)
+  {
+    hit_samples.clear();
+    size_t bin_end = bin_start;
+    for (; bin_end < sample_bins.size() && sample_bins[bin_end].first == sample_bins[bin_start].first; ++bin_end)
+    {
+      const RayBatchVoxel &voxel = voxels[sample_bins[bin_end].second];
+      const RayBatchRay &ray = rays[voxel.ray_index];
+      hit_samples.emplace_back(
+        HitSample{ ray.start, ray.end, voxel.enter_range, (timestamps) ? timestamps[ray.source_index] : 0 });
+    }
+    integrateHitVoxel<kFeatures>(buffers, params, map, voxels[sample_bins[bin_start].second].key, hit_samples.data(),
+                                 hit_samples.size());
+    bin_start = bin_end;
+  }
+}
+
+
+/// Voxel update functions instantiated for one @c OccupancyUpdateFeature combination. Selected once per
+/// @c RayMapperOccupancy::integrateRays() call by @c selectOccupancyUpdate() .
+struct OccupancyUpdateFunctions
+{
+  /// @c integrateMissVoxel() instantiation.
+  bool (*miss)(OccupancyChunkBuffers &, const OccupancyUpdateParams &, const Key &, double, double, bool);
+  /// @c integrateHitVoxel() single sample instantiation.
+  void (*hit)(OccupancyChunkBuffers &, const OccupancyUpdateParams &, const OccupancyMap &, const Key &,
+              const glm::dvec3 &, const glm::dvec3 &, double, double);
+  /// @c integrateRegion() instantiation.
+  void (*region)(OccupancyChunkBuffers &, const OccupancyUpdateParams &, const OccupancyMap &, const RayBatchRay *,
+                 const double *, const RayBatchVoxel *, size_t);
+};
+
+
+template <size_t... kFeatures>
+std::array<OccupancyUpdateFunctions, sizeof...(kFeatures)>
+  makeOccupancyUpdateTable(std::index_sequence<kFeatures...> /*features*/)
+{
+  return { { OccupancyUpdateFunctions{ &integrateMissVoxel<unsigned(kFeatures)>,
+                                       &integrateHitVoxel<unsigned(kFeatures)>,
+                                       &integrateRegion<unsigned(kFeatures)> }... } };
+}
+
+
+/// Select the voxel update functions specialised for the layers enabled in @p params .
+const OccupancyUpdateFunctions &selectOccupancyUpdate(const OccupancyUpdateParams &params)
+{
+  static const std::array<OccupancyUpdateFunctions, kOufCombinations> table =
+    makeOccupancyUpdateTable(std::make_index_sequence<kOufCombinations>());
+  return table[occupancyUpdateFeatures(params)];
+}
+}  // namespace
+
 RayMapperOccupancy::RayMapperOccupancy(OccupancyMap *map)
   : map_(map)
   , occupancy_layer_(map_->layout().occupancyLayer())
@@ -31,6 +606,8 @@ RayMapperOccupancy::RayMapperOccupancy(OccupancyMap *map)
   , traversal_layer_(map_->layout().traversalLayer())
   , touch_time_layer_(map_->layout().layerIndex(default_layer::touchTimeLayerName()))
   , incident_normal_layer_(map_->layout().layerIndex(default_layer::incidentNormalLayerName()))
+  , touch_incident_layer_(map_->layout().layerIndex(default_layer::touchIncidentLayerName()))
+  , occupancy_state_layer_(map_->layout().layerIndex(default_layer::occupancyStateLayerName()))
 {
   // Use Voxel to validate the layers.
   // In processing we use VoxelBuffer instead of Voxel objects. While Voxel makes for a neater API, using VoxelBuffer
@@ -40,8 +617,11 @@ RayMapperOccupancy::RayMapperOccupancy(OccupancyMap *map)
   Voxel<const float> traversal(map_, traversal_layer_);
   Voxel<const uint32_t> touch_time_layer(map_, touch_time_layer_);
   Voxel<const uint32_t> incident_normal_layer(map_, incident_normal_layer_);
+  Voxel<const VoxelTouchIncident> touch_incident_layer(map_, touch_incident_layer_);
+  Voxel<const uint16_t> occupancy_state_layer(map_, occupancy_state_layer_);
 
   occupancy_dim_ = occupancy.isLayerValid() ? occupancy.layerDim() : occupancy_dim_;
+  occupancy_order_ = occupancy.isLayerValid() ? occupancy.layerVoxelOrder() : occupancy_order_;
 
   // Validate we only have an occupancy layer or we also have a mean layer and the layer dimesions match.
   valid_ = occupancy.isLayerValid() && !mean.isLayerValid() ||
@@ -59,283 +639,307 @@ RayMapperOccupancy::RayMapperOccupancy(OccupancyMap *map)
   {
     valid_ = valid_ && occupancy.layerDim() == incident_normal_layer.layerDim();
   }
+
+  if (touch_incident_layer.isLayerValid())
+  {
+    valid_ = valid_ && occupancy.layerDim() == touch_incident_layer.layerDim();
+  }
+
+  // The state layer is derived data, so an unexpected layout disables its update rather than the mapper.
+  if (occupancy_state_layer.isLayerValid() && occupancy.isLayerValid() &&
+      occupancy_state_layer.layerDim() * uint8_t(2) == occupancy.layerDim())
+  {
+    occupancy_state_dim_ = occupancy_state_layer.layerDim();
+    occupancy_state_order_ = occupancy_state_layer.layerVoxelOrder();
+  }
+  else
+  {
+    occupancy_state_layer_ = -1;
+  }
 }
 
 
 RayMapperOccupancy::~RayMapperOccupancy() = default;
 
 
+void RayMapperOccupancy::setUseThreads(bool use_threads)
+{
+  use_threads_ = use_threads;
+}
+
+
+void RayMapperOccupancy::setNumaAware(bool numa_aware)
+{
+  batch_.setNumaAware(numa_aware);
+}
+
+
+bool RayMapperOccupancy::numaAware() const
+{
+  return batch_.numaAware();
+}
+
+
+void RayMapperOccupancy::setRegionFilter(const RegionFilterFunction &filter)
+{
+  region_filter_ = filter;
+}
+
+
+const RayMapperOccupancy::RegionFilterFunction &RayMapperOccupancy::regionFilter() const
+{
+  return region_filter_;
+}
+
+
+void RayMapperOccupancy::setChangedKeys(KeyList *changed_keys)
+{
+  changed_keys_ = changed_keys;
+}
+
+
+bool RayMapperOccupancy::useThreads() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return use_threads_;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
 size_t RayMapperOccupancy::integrateRays(const glm::dvec3 *rays, size_t element_count, const float * /*intensities*/,
                                          const double *timestamps, unsigned ray_update_flags)
 {
-  KeyList keys;
-  MapChunk *last_chunk = nullptr;
-  MapChunk *last_mean_chunk = nullptr;
-  VoxelBuffer<VoxelBlock> occupancy_buffer;
-  VoxelBuffer<VoxelBlock> mean_buffer;
-  VoxelBuffer<VoxelBlock> traversal_buffer;
-  VoxelBuffer<VoxelBlock> touch_time_buffer;
-  VoxelBuffer<VoxelBlock> incidents_buffer;
-  double last_exit_range = 0;
-  bool stop_adjustments = false;
+  PROFILE(RayMapperOccupancy_integrateRays);
+  const auto start_time = std::chrono::steady_clock::now();
+  const metrics::CoreMetrics &core_metrics = metrics::coreMetrics();
+  const auto record_metrics = [&core_metrics, start_time](size_t ray_count, size_t filtered_count) {
+    core_metrics.rays_integrated.add(ray_count);
+    core_metrics.rays_filtered.add(filtered_count);
+    core_metrics.integrate_rays_seconds.observe(
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+  };
+
+  OccupancyUpdateParams params;
+  params.occupancy_layer = occupancy_layer_;
+  params.mean_layer = mean_layer_;
+  params.traversal_layer = traversal_layer_;
+  params.touch_time_layer = (timestamps) ? touch_time_layer_ : -1;
+  params.incident_normal_layer = incident_normal_layer_;
+  params.touch_incident_layer = touch_incident_layer_;
+  params.touch_incident_time = timestamps != nullptr;
+  params.occupancy_state_layer = occupancy_state_layer_;
+  params.occupancy_dim = occupancy_dim_;
+  params.occupancy_order = occupancy_order_;
+  params.occupancy_state_dim = occupancy_state_dim_;
+  params.occupancy_state_order = occupancy_state_order_;
+  params.occupancy_threshold_value = map_->occupancyThresholdValue();
+  params.miss_value = map_->missValue();
+  params.hit_value = map_->hitValue();
+  params.resolution = map_->resolution();
+  params.voxel_min = map_->minVoxelValue();
+  params.voxel_max = map_->maxVoxelValue();
+  params.saturation_min = map_->saturateAtMinValue() ? params.voxel_min : std::numeric_limits<float>::lowest();
+  params.saturation_max = map_->saturateAtMaxValue() ? params.voxel_max : std::numeric_limits<float>::max();
+  params.ray_update_flags = ray_update_flags;
+  params.record_changes = changed_keys_ != nullptr;
+
+  if (element_count)
+  {
+    // Page out old regions and meet the memory budget before we start binding chunks, keeping regions around the
+    // sensor.
+    map_->updateRegionPaging(rays[0]);
+    map_->enforceMemoryBudget();
+  }
 
-  const RayFilterFunction ray_filter = map_->rayFilter();
-  const bool use_filter = bool(ray_filter);
-  const auto occupancy_layer = occupancy_layer_;
-  const auto mean_layer = mean_layer_;
-  const auto traversal_layer = traversal_layer_;
-  const auto occupancy_dim = occupancy_dim_;
-  const auto occupancy_threshold_value = map_->occupancyThresholdValue();
-  const auto miss_value = map_->missValue();
-  const auto hit_value = map_->hitValue();
-  const auto resolution = map_->resolution();
-  const auto voxel_min = map_->minVoxelValue();
-  const auto voxel_max = map_->maxVoxelValue();
-  const auto saturation_min = map_->saturateAtMinValue() ? voxel_min : std::numeric_limits<float>::lowest();
-  const auto saturation_max = map_->saturateAtMaxValue() ? voxel_max : std::numeric_limits<float>::max();
   // Touch the map to flag changes.
-  const auto touch_stamp = map_->touch();
+  params.touch_stamp = map_->touch();
 
   if (timestamps)
   {
     // Update first ray time if not yet set.
     map_->updateFirstRayTime(*timestamps);
   }
+  params.time_base = map_->firstRayTime();
 
-  const auto visit_func = [&](const Key &key, double enter_range, double exit_range) -> bool  //
+  if (timestamps && params.touch_time_layer >= 0 && map_->occupancyDecayTime() > 0)
   {
-    // The update logic here is a little unclear as it tries to avoid outright branches.
-    // The intended logic is described as follows:
-    // 1. Select direct write or additive adjustment.
-    //    - Make a direct, non-additive adjustment if one of the following conditions are met:
-    //      - stop_adjustments is true
-    //      - the voxel is uncertain
-    //      - ray_update_flags and kRfExclude<Type> flags pass.
-    //      - voxel is saturated
-    //    - Otherwise add to present value.
-    // 2. Select the value adjustment
-    //    - current_value if one of the following conditions are met:
-    //      - stop_adjustments is true (no longer making adjustments)
-    //      - ray_update_flags and kRfExclude<Type> flags pass.
-    //    - miss_value otherwise
-    // 3. Calculate new value
-    // 4. Apply saturation logic: only min saturation relevant
-    //    -
-    MapChunk *chunk =
-      (last_chunk && key.regionKey() == last_chunk->region.coord) ? last_chunk : map_->region(key.regionKey(), true);
-    if (chunk != last_chunk)
-    {
-      occupancy_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
-      if (traversal_layer >= 0)
-      {
-        traversal_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[traversal_layer]);
-      }
-      if (touch_time_layer_ >= 0 && timestamps)
-      {
-        // Touch time not required for miss update, but we need it in sync for the update later.
-        touch_time_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[touch_time_layer_]);
-      }
-      if (incident_normal_layer_ >= 0)
-      {
-        // Incidents not required for miss update, but we need it in sync for the update later.
-        incidents_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[incident_normal_layer_]);
-      }
-    }
-    last_chunk = chunk;
-    const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim);
-    float occupancy_value;
-    occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
-    const float initial_value = occupancy_value;
-
-    const bool initially_unobserved = initial_value == unobservedOccupancyValue();
-    const bool initially_free = !initially_unobserved && initial_value < occupancy_threshold_value;
-    const bool initially_occupied = !initially_unobserved && initial_value >= occupancy_threshold_value;
-
-    // Calculate the adjustment to make based on the initial occupancy value, various exclusion flags and the configured
-    // value adjustment.
-    float miss_adjustment = miss_value;
-    // The next series of statements are designed to modify the miss_adjustment according to the current voxel state
-    // and the kRfExclude<Type> values. Note that for kRfExcludeUnobserved we set the miss_adjustment such that it keeps
-    // the observesed value, whereas in other cases we set to zero to make for no change. This is because unobserved
-    // values have a value written, whereas other voxels have use addition to adjust the value.
-    miss_adjustment = (initially_unobserved && (ray_update_flags & kRfExcludeUnobserved)) ? unobservedOccupancyValue() :
-                                                                                            miss_adjustment;
-    miss_adjustment = (initially_free && (ray_update_flags & kRfExcludeFree)) ? 0.0f : miss_adjustment;
-    miss_adjustment = (initially_occupied && (ray_update_flags & kRfExcludeOccupied)) ? 0.0f : miss_adjustment;
-
-    occupancyAdjustMiss(&occupancy_value, initial_value, miss_adjustment, unobservedOccupancyValue(), voxel_min,
-                        saturation_min, saturation_max, stop_adjustments);
-    occupancy_buffer.writeVoxel(voxel_index, occupancy_value);
-
-    // Accumulate traversal
-    if (traversal_layer >= 0)
-    {
-      float traversal;
-      traversal_buffer.readVoxel(voxel_index, &traversal);
-      traversal += float(exit_range - enter_range);
-      traversal_buffer.writeVoxel(voxel_index, traversal);
-    }
+    // Lazy decay: decay each voxel to the latest time in this update before adjusting it.
+    params.decay_time = map_->occupancyDecayTime();
+    params.update_time = *std::max_element(timestamps, timestamps + element_count / 2);
+    params.update_touch_time = encodeVoxelTouchTime(params.time_base, params.update_time);
+  }
 
-    // Lint(KS): The analyser takes some branches which are not possible in practice.
-    // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
-    chunk->updateFirstValid(voxel_index);
+  // Use the region batched update unless kRfStopOnFirstOccupied is set. That flag makes the update of each voxel
+  // depend on the state of preceding voxels along the ray, which may be in other regions.
+  if (!(ray_update_flags & kRfStopOnFirstOccupied))
+  {
+    size_t filtered_count = 0;
+    const size_t ray_count = integrateRaysBatched(params, rays, element_count, timestamps, &filtered_count);
+    record_metrics(ray_count, filtered_count);
+    return ray_count;
+  }
 
-    stop_adjustments = stop_adjustments || ((ray_update_flags & kRfStopOnFirstOccupied) && initially_occupied);
-    chunk->dirty_stamp = touch_stamp;
-    // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
-    // not so much the sequencing. We really don't want to synchronise here.
-    chunk->touched_stamps[occupancy_layer].store(touch_stamp, std::memory_order_relaxed);
+  OccupancyChunkBuffers buffers;
+  double last_exit_range = 0;
+  bool stop_adjustments = false;
+  const OccupancyUpdateFunctions &update = selectOccupancyUpdate(params);
 
+  const auto visit_func = [&](const Key &key, double enter_range, double exit_range) -> bool  //
+  {
     // Store last exit range for final traversal accumulation.
     last_exit_range = exit_range;
-
+    if (region_filter_ && !region_filter_(key.regionKey()))
+    {
+      return true;
+    }
+    bindChunk(buffers, params, *map_, key.regionKey());
+    const bool initially_occupied = update.miss(buffers, params, key, enter_range, exit_range, stop_adjustments);
+    stop_adjustments = stop_adjustments || ((ray_update_flags & kRfStopOnFirstOccupied) && initially_occupied);
     return true;
   };
 
-  glm::dvec3 start;
-  glm::dvec3 end;
-  unsigned filter_flags;
-  double time_base = 0;
-
-  if (timestamps)
-  {
-    // Update first ray time if not yet set.
-    map_->updateFirstRayTime(*timestamps);
-  }
-  time_base = map_->firstRayTime();
+  const size_t ray_count = element_count / 2;
+  size_t filtered_count = 0;
 
-  for (size_t i = 0; i < element_count; i += 2)
+  for (size_t block_start = 0; block_start < ray_count; block_start += RayBatch::kDefaultBatchSize)
   {
-    filter_flags = 0;
-    start = rays[i];
-    end = rays[i + 1];
+    const size_t block_count = std::min<size_t>(RayBatch::kDefaultBatchSize, ray_count - block_start);
+    filtered_count += filterRays(rays + block_start * 2, block_count);
 
-    if (use_filter)
+    for (size_t j = 0; j < block_count; ++j)
     {
-      if (!ray_filter(&start, &end, &filter_flags))
+      const unsigned filter_flags = filter_flags_[j];
+      if (filter_flags & kRffInvalid)
       {
         // Bad ray.
         continue;
       }
-    }
 
-    // Explicit update of the end voxel if it's a sample, include in ray if clipped.
-    const bool include_sample_in_ray = (filter_flags & kRffClippedEnd) || (ray_update_flags & kRfEndPointAsFree);
-    unsigned walk_flags = (!include_sample_in_ray) ? kExcludeEndVoxel : 0u;
-    // Skip the start voxel according to ray_update_flags.
-    walk_flags |= (ray_update_flags & kRfExcludeOrigin) ? kExcludeStartVoxel : 0u;
+      const glm::dvec3 &start = filtered_rays_[j * 2 + 0];
+      const glm::dvec3 &end = filtered_rays_[j * 2 + 1];
 
-    if (!(ray_update_flags & kRfExcludeRay))
-    {
-      stop_adjustments = false;
-      walkSegmentKeys(LineWalkContext(*map_, visit_func), start, end, walk_flags);
-    }
+      // Explicit update of the end voxel if it's a sample, include in ray if clipped.
+      const bool include_sample_in_ray = (filter_flags & kRffClippedEnd) || (ray_update_flags & kRfEndPointAsFree);
+      unsigned walk_flags = (!include_sample_in_ray) ? kExcludeEndVoxel : 0u;
+      // Skip the start voxel according to ray_update_flags.
+      walk_flags |= (ray_update_flags & kRfExcludeOrigin) ? kExcludeStartVoxel : 0u;
 
-    if (!stop_adjustments && !include_sample_in_ray && !(ray_update_flags & kRfExcludeSample))
-    {
-      // Like the miss logic, we have similar obfuscation here to avoid branching. It's a little simpler though,
-      // because we do have a branch above, which will filter some of the conditions catered for in miss integration.
-      const ohm::Key key = map_->voxelKey(end);
-      MapChunk *chunk =
-        (last_chunk && key.regionKey() == last_chunk->region.coord) ? last_chunk : map_->region(key.regionKey(), true);
-      if (chunk != last_chunk)
+      if (!(ray_update_flags & kRfExcludeRay))
       {
-        occupancy_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
-        if (traversal_layer >= 0)
-        {
-          traversal_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[traversal_layer]);
-        }
-        if (touch_time_layer_ >= 0 && timestamps)
-        {
-          touch_time_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[touch_time_layer_]);
-        }
-        if (incident_normal_layer_ >= 0)
-        {
-          incidents_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[incident_normal_layer_]);
-        }
+        stop_adjustments = false;
+        walkSegmentKeys(LineWalkContext(*map_, visit_func), start, end, walk_flags);
       }
-      last_chunk = chunk;
-      const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim);
-
-      float occupancy_value;
-      occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
-      const float initial_value = occupancy_value;
-
-      const bool initially_unobserved = initial_value == unobservedOccupancyValue();
-      const bool initially_free = !initially_unobserved && initial_value < occupancy_threshold_value;
-      const bool initially_occupied = !initially_unobserved && initial_value >= occupancy_threshold_value;
-
-      // Calculate the adjustment to make based on the initial occupancy value, various exclusion flags and the
-      // configured value adjustment (see the equivalent section for the miss update). Note the adjustment for skipping
-      // an initially_unobserved voxel is not zero - it's unobservedOccupancyValue()/infinity to keep the state
-      // unchanged.
-      float hit_adjustment = hit_value;
-      hit_adjustment = (initially_unobserved && (ray_update_flags & kRfExcludeUnobserved)) ?
-                         unobservedOccupancyValue() :
-                         hit_adjustment;
-      hit_adjustment = (initially_free && (ray_update_flags & kRfExcludeFree)) ? 0.0f : hit_adjustment;
-      hit_adjustment = (initially_occupied && (ray_update_flags & kRfExcludeOccupied)) ? 0.0f : hit_adjustment;
-
-      occupancyAdjustHit(&occupancy_value, initial_value, hit_adjustment, unobservedOccupancyValue(), voxel_max,
-                         saturation_min, saturation_max, stop_adjustments);
-
-      // update voxel mean if present.
-      unsigned sample_count = 0;
-      if (mean_layer >= 0)
+
+      if (!stop_adjustments && !include_sample_in_ray && !(ray_update_flags & kRfExcludeSample))
       {
-        if (chunk != last_mean_chunk)
+        const ohm::Key key = map_->voxelKey(end);
+        if (region_filter_ && !region_filter_(key.regionKey()))
         {
-          mean_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[mean_layer]);
+          continue;
         }
-        last_mean_chunk = chunk;
-        VoxelMean voxel_mean;
-        mean_buffer.readVoxel(voxel_index, &voxel_mean);
-        voxel_mean.coord =
-          subVoxelUpdate(voxel_mean.coord, voxel_mean.count, end - map_->voxelCentreGlobal(key), resolution);
-        sample_count = voxel_mean.count;
-        ++voxel_mean.count;
-        mean_buffer.writeVoxel(voxel_index, voxel_mean);
-        // Lint(KS): The analyser takes some branches which are not possible in practice.
-        // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
-        chunk->touched_stamps[mean_layer].store(touch_stamp, std::memory_order_relaxed);
+        bindChunk(buffers, params, *map_, key.regionKey());
+        update.hit(buffers, params, *map_, key, start, end, last_exit_range,
+                   (timestamps) ? timestamps[block_start + j] : 0);
       }
-      occupancy_buffer.writeVoxel(voxel_index, occupancy_value);
+    }
+  }
 
-      // Accumulate traversal
-      if (traversal_layer >= 0)
-      {
-        float traversal;
-        traversal_buffer.readVoxel(voxel_index, &traversal);
-        traversal += float(glm::length(end - start) - last_exit_range);
-        traversal_buffer.writeVoxel(voxel_index, traversal);
-      }
+  if (changed_keys_)
+  {
+    for (const Key &key : buffers.changed_keys)
+    {
+      changed_keys_->emplace_back(key);
+    }
+  }
+
+  record_metrics(element_count / 2, filtered_count);
+  return element_count / 2;
+}
+
+
+size_t RayMapperOccupancy::integrateRaysBatched(const OccupancyUpdateParams &params, const glm::dvec3 *rays,
+                                                size_t element_count, const double *timestamps,
+                                                size_t *filtered_count)
+{
+  const size_t ray_count = element_count / 2;
+  const unsigned ray_update_flags = params.ray_update_flags;
+  const bool use_threads = useThreads();
+  const OccupancyMap &map = *map_;
+  double last_exit_range = 0;
+
+  // Resolve the layer updates once for the whole call.
+  const auto integrate_region = selectOccupancyUpdate(params).region;
+
+  const auto update_region = [this, &params, &map, timestamps, integrate_region](
+                               const RayBatchRegion &region, const RayBatchVoxel *voxels, size_t voxel_count) {
+    if (region_filter_ && !region_filter_(region.region_key))
+    {
+      return;
+    }
+
+    OccupancyChunkBuffers buffers;
+    bindChunk(buffers, params, region.chunk);
+    integrate_region(buffers, params, map, batch_.rays().data(), timestamps, voxels, voxel_count);
 
-      if (touch_time_layer_ >= 0 && timestamps)
+    if (changed_keys_ && !buffers.changed_keys.empty())
+    {
+      // Regions may be updated concurrently.
+      std::unique_lock<Mutex> guard(changed_keys_lock_);
+      for (const Key &key : buffers.changed_keys)
       {
-        const unsigned touch_time = encodeVoxelTouchTime(time_base, timestamps[i >> 1]);
-        touch_time_buffer.writeVoxel(voxel_index, touch_time);
+        changed_keys_->emplace_back(key);
       }
+    }
+  };
+
+  for (size_t batch_start = 0; batch_start < ray_count; batch_start += RayBatch::kDefaultBatchSize)
+  {
+    const size_t batch_end = std::min(batch_start + RayBatch::kDefaultBatchSize, ray_count);
+    batch_.clear();
+    batch_.reserve(batch_end - batch_start);
+
+    // Filter the whole batch in a separate pass.
+    *filtered_count += filterRays(rays + batch_start * 2, batch_end - batch_start);
 
-      if (incident_normal_layer_ >= 0)
+    for (size_t i = batch_start; i < batch_end; ++i)
+    {
+      const unsigned filter_flags = filter_flags_[i - batch_start];
+      if (filter_flags & kRffInvalid)
       {
-        unsigned packed_normal{};
-        incidents_buffer.readVoxel(voxel_index, &packed_normal);
-        packed_normal = updateIncidentNormal(packed_normal, start - end, sample_count);
-        incidents_buffer.writeVoxel(voxel_index, packed_normal);
+        // Bad ray.
+        continue;
       }
 
-      // Lint(KS): The analyser takes some branches which are not possible in practice.
-      // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
-      chunk->updateFirstValid(voxel_index);
+      const glm::dvec3 &start = filtered_rays_[(i - batch_start) * 2 + 0];
+      const glm::dvec3 &end = filtered_rays_[(i - batch_start) * 2 + 1];
+
+      // Explicit update of the end voxel if it's a sample, include in ray if clipped.
+      const bool include_sample_in_ray = (filter_flags & kRffClippedEnd) || (ray_update_flags & kRfEndPointAsFree);
+      unsigned walk_flags = (!include_sample_in_ray) ? kExcludeEndVoxel : 0u;
+      // Skip the start voxel according to ray_update_flags.
+      walk_flags |= (ray_update_flags & kRfExcludeOrigin) ? kExcludeStartVoxel : 0u;
 
-      chunk->dirty_stamp = touch_stamp;
-      // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
-      // not so much the sequencing. We really don't want to synchronise here.
-      chunk->touched_stamps[occupancy_layer].store(touch_stamp, std::memory_order_relaxed);
+      unsigned batch_flags = (!(ray_update_flags & kRfExcludeRay)) ? kRbWalk : 0u;
+      batch_flags |= (!include_sample_in_ray && !(ray_update_flags & kRfExcludeSample)) ? kRbSample : 0u;
+      batch_.addRay(start, end, i, walk_flags, batch_flags);
     }
+
+    batch_.build(*map_, use_threads, &last_exit_range);
+    batch_.forEachRegion(update_region, use_threads);
   }
 
-  return element_count / 2;
+  return ray_count;
+}
+
+
+size_t RayMapperOccupancy::filterRays(const glm::dvec3 *rays, size_t ray_count)
+{
+  filtered_rays_.assign(rays, rays + ray_count * 2);
+  filter_flags_.resize(ray_count);
+  return ohm::filterRays(filtered_rays_.data(), filter_flags_.data(), ray_count, map_->rayBatchFilter(),
+                         map_->rayFilter());
 }
 
 
@@ -9,6 +9,8 @@
 
 #include "CalculateSegmentKeys.h"
 #include "KeyList.h"
+#include "Mutex.h"
+#include "RayBatch.h"
 #include "RayFilter.h"
 #include "RayFlag.h"
 #include "RayMapper.h"
@@ -16,18 +18,30 @@
 
 #include <glm/vec3.hpp>
 
+#include <functional>
+#include <vector>
+
 namespace ohm
 {
 /// A @c RayMapper implementation built around updating a map in CPU. This mapper supports basic occupancy population
 /// and @c VoxelMean update (if enabled by the map) - @c MayLayout::occupancyLayer() and @c MapLayout::meanLayer()
 /// respectively.
 ///
-/// The @c integrateRays() implementation performs a single threaded walk of the voxels to update and touches
-/// those voxels one at a time, updating their occupancy value. The given @c OccupancyMap must have an occupancy
-/// layer and may have a @c VoxelMean layer.
+/// The @c integrateRays() implementation walks the voxels to update using a @c RayBatch , then touches those voxels
+/// one region at a time, updating their occupancy value. The given @c OccupancyMap must have an occupancy layer and
+/// may have a @c VoxelMean layer.
+///
+/// The occupancy state layer is updated along with the occupancy layer when present - see @c MapFlag::kOccupancyState
+/// and @c updateOccupancyState() .
+///
+/// When built with @c OHM_FEATURE_THREADS , a multi-threaded update may be enabled via @c setUseThreads() . See
+/// @c integrateRays() for details.
 class ohm_API RayMapperOccupancy : public RayMapper
 {
 public:
+  /// Function used to restrict the regions updated by @c integrateRays() . See @c setRegionFilter() .
+  using RegionFilterFunction = std::function<bool(const glm::i16vec3 &region_key)>;
+
   /// Constructor, wrapping the interface around the given @p map .
   ///
   /// @param map The target map. Must outlive this class.
@@ -40,13 +54,67 @@ public:
   /// @return True if valid and @c integrateRays() is safe to call.
   inline bool valid() const override { return valid_; }
 
+  /// Enable or disable multi-threaded ray integration. Ignored unless built with @c OHM_FEATURE_THREADS .
+  /// @param use_threads True to enable threaded integration.
+  void setUseThreads(bool use_threads);
+
+  /// Enable NUMA aware region placement for threaded integration. Regions are partitioned between NUMA nodes by
+  /// spatial key with the region memory allocated and updated by workers on the region's node.
+  /// See @c RayBatch::setNumaAware() . Only effective with @c useThreads() on a multi-node system.
+  /// @param numa_aware True to enable NUMA aware placement.
+  void setNumaAware(bool numa_aware);
+
+  /// Query if NUMA aware region placement is enabled. See @c setNumaAware() .
+  /// @return True if enabled.
+  bool numaAware() const;
+
+  /// Set a list to which @c integrateRays() appends the @c Key of each voxel which changes occupancy type. A voxel
+  /// changes type when it becomes observed, or when it changes between being occupied and not occupied.
+  ///
+  /// This supports incremental updates of layers derived from occupancy, such as an @c EsdfProcess . The order of the
+  /// appended keys is undefined when @c useThreads() is set, and a key may be appended multiple times. The list is
+  /// never cleared by this class.
+  ///
+  /// @param changed_keys The list to append changed keys to. Must outlive this class or be cleared with null.
+  void setChangedKeys(KeyList *changed_keys);
+
+  /// Query the list set via @c setChangedKeys() .
+  /// @return The changed key list, or null when not recording changes.
+  inline KeyList *changedKeys() const { return changed_keys_; }
+
+  /// Set a filter restricting which regions are updated by @c integrateRays() .
+  ///
+  /// Rays are still walked in full, but voxels are only updated in regions for which @p filter returns @c true . This
+  /// mirrors @c GpuMap::setRegionFilter() and supports splitting the update of a map between mappers by region, such as
+  /// by @c GpuHybridMap . Regions failing the filter may still be created in the map. With @c kRfStopOnFirstOccupied ,
+  /// only voxels in regions passing the filter can stop a ray.
+  ///
+  /// @param filter The region filter. An empty function updates all regions (default).
+  void setRegionFilter(const RegionFilterFunction &filter);
+
+  /// Get the filter restricting which regions are updated. See @c setRegionFilter() .
+  /// @return The region filter. Empty when all regions are updated.
+  const RegionFilterFunction &regionFilter() const;
+
+  /// Is multi-threaded ray integration enabled? Always false when not built with @c OHM_FEATURE_THREADS .
+  /// @return True if threaded integration is enabled and available.
+  bool useThreads() const;
+
   /// Performs the ray integration.
   ///
-  /// This is updated in a single threaded fashion. For each ray we walk the affected voxel @c Key set and
-  /// update those voxels. Voxels along each line segment have their occupancy probability diminished, while
-  /// the end voxel of each segment has the probability increase. The end voxel will also have its @c VoxelMean
-  /// updated if the map has a @c MapLayout::meanLayer() . This behaviour may be modified by the @p RayFlag
-  /// bits in @p ray_update_flags .
+  /// Rays are processed in batches using a @c RayBatch . For each batch, we walk the affected voxel @c Key set for each
+  /// ray, group the voxels by region and update each region in turn. Voxels along each line segment have their
+  /// occupancy probability diminished, while the end voxel of each segment has the probability increase. The end voxel
+  /// will also have its @c VoxelMean updated if the map has a @c MapLayout::meanLayer() . This behaviour may be
+  /// modified by the @p RayFlag bits in @p ray_update_flags .
+  ///
+  /// When @c useThreads() is set, the ray segments are walked in parallel and each region is updated in parallel.
+  /// Voxels within each region are updated in ray order, so the results exactly match the single threaded update.
+  /// Rays are walked and updated one at a time without batching for @c kRfStopOnFirstOccupied since that flag makes
+  /// voxel updates depend on preceding voxels along each ray.
+  ///
+  /// Setting @c kRfAggregateSamples bins the samples in each batch region by voxel and makes one hit update per voxel
+  /// after the region's miss updates. The flag is ignored with @c kRfStopOnFirstOccupied .
   ///
   /// Should only be called if @c valid() is true.
   ///
@@ -80,15 +148,48 @@ public:
 
   using RayMapper::integrateRays;
 
+  /// Cached map and layer parameters used to update voxels. For internal use.
+  struct OccupancyUpdateParams;
+
 protected:
+  /// Region batched implementation of @c integrateRays() . Does not support @c kRfStopOnFirstOccupied .
+  /// @param params Cached update parameters.
+  /// @param rays The array of start/end point pairs to integrate.
+  /// @param element_count The number of @c glm::dvec3 elements in @p rays .
+  /// @param timestamps Optional per ray timestamps.
+  /// @param[in,out] filtered_count Incremented for each ray rejected by the @c OccupancyMap::rayFilter() .
+  /// @return The number of rays integrated.
+  size_t integrateRaysBatched(const OccupancyUpdateParams &params, const glm::dvec3 *rays, size_t element_count,
+                              const double *timestamps, size_t *filtered_count);
+
+  /// Copy @p ray_count rays into @c filtered_rays_ and apply the map ray filters as a single pass, setting the
+  /// @c filter_flags_ for each ray. See @c ohm::filterRays() .
+  /// @param rays The array of start/end point pairs to filter.
+  /// @param ray_count The number of rays - half the number of @p rays elements.
+  /// @return The number of rays culled by the filter.
+  size_t filterRays(const glm::dvec3 *rays, size_t ray_count);
+
+
   OccupancyMap *map_ = nullptr;           ///< Target map.
   int occupancy_layer_ = -1;              ///< Cached occupancy layer index.
   int mean_layer_ = -1;                   ///< Cached voxel mean layer index.
   int traversal_layer_ = -1;              ///< The traversal layer index.
   int touch_time_layer_ = -1;             ///< Cache touch time layer index.
   int incident_normal_layer_ = -1;        ///< Cache incident normal layer index.
+  int touch_incident_layer_ = -1;         ///< Cache packed touch time and incident normal layer index.
+  int occupancy_state_layer_ = -1;        ///< Cache occupancy state layer index.
   glm::u8vec3 occupancy_dim_{ 0, 0, 0 };  ///< Cached occupancy layer voxel dimensions. Voxel mean must exactly match.
+  VoxelOrder occupancy_order_ = VoxelOrder::kRowMajor;  ///< Cached occupancy layer voxel order.
+  glm::u8vec3 occupancy_state_dim_{ 0, 0, 0 };           ///< Cached occupancy state layer voxel dimensions.
+  VoxelOrder occupancy_state_order_ = VoxelOrder::kRowMajor;  ///< Cached occupancy state layer voxel order.
   bool valid_ = false;                    ///< Has layer validation passed?
+  bool use_threads_ = false;              ///< Use multi-threaded integration (if available)?
+  RayBatch batch_;                        ///< Ray batching helper.
+  std::vector<glm::dvec3> filtered_rays_;  ///< Rays after the filter pass. See @c filterRays() .
+  std::vector<unsigned> filter_flags_;     ///< @c RayFilterFlag values for each of the @c filtered_rays_ .
+  KeyList *changed_keys_ = nullptr;       ///< Optional list of voxels which change occupancy type.
+  RegionFilterFunction region_filter_;    ///< Optional filter on the regions to update.
+  Mutex changed_keys_lock_;               ///< Guards @c changed_keys_ in threaded updates.
 };
 
 }  // namespace ohm
@@ -14,6 +14,9 @@
 #include "VoxelBuffer.h"
 #include "VoxelSecondarySample.h"
 
+#include <algorithm>
+#include <cassert>
+
 namespace ohm
 {
 RayMapperSecondarySample::RayMapperSecondarySample(OccupancyMap *map)
@@ -26,6 +29,7 @@ RayMapperSecondarySample::RayMapperSecondarySample(OccupancyMap *map)
   Voxel<const VoxelSecondarySample> secondary_sample(map_, secondary_samples_layer_);
 
   layer_dim_ = secondary_sample.isLayerValid() ? secondary_sample.layerDim() : layer_dim_;
+  layer_order_ = secondary_sample.isLayerValid() ? secondary_sample.layerVoxelOrder() : layer_order_;
   valid_ = secondary_sample.isLayerValid();
 }
 
@@ -40,38 +44,51 @@ size_t RayMapperSecondarySample::integrateRays(const glm::dvec3 *rays, size_t el
   (void)timestamps;
   (void)ray_update_flags;
 
-  MapChunk *last_chunk = nullptr;
-  VoxelBuffer<VoxelBlock> secondary_sample_buffer;
   VoxelSecondarySample voxel{};
 
   const auto secondary_samples_layer = secondary_samples_layer_;
   const auto layer_dim = layer_dim_;
+  const auto layer_order = layer_order_;
   // Touch the map to flag changes.
   const auto touch_stamp = map_->touch();
 
-  for (size_t i = 0; i < element_count; i += 2)
+  // Update the sample voxels in a single region. The voxel buffer is loaded once per region.
+  const auto update_region = [&](const RayBatchRegion &region, const RayBatchVoxel *voxels, size_t voxel_count)  //
   {
-    const double range = glm::length(rays[i + 1] - rays[i]);
-    const ohm::Key key = map_->voxelKey(rays[i + 1]);
-    MapChunk *chunk =
-      (last_chunk && key.regionKey() == last_chunk->region.coord) ? last_chunk : map_->region(key.regionKey(), true);
-
-    if (chunk != last_chunk)
+    MapChunk *chunk = region.chunk;
+    assert(chunk);
+    VoxelBuffer<VoxelBlock> secondary_sample_buffer(chunk->voxel_blocks[secondary_samples_layer]);
+    for (size_t v = 0; v < voxel_count; ++v)
     {
-      secondary_sample_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[secondary_samples_layer]);
-    }
-    last_chunk = chunk;
-    const unsigned voxel_index = ohm::voxelIndex(key, layer_dim);
+      const RayBatchRay &ray = batch_.rays()[voxels[v].ray_index];
+      const double range = glm::length(ray.end - ray.start);
+      const unsigned voxel_index = ohm::voxelIndex(voxels[v].key, layer_dim, layer_order);
 
-    secondary_sample_buffer.readVoxel(voxel_index, &voxel);
-    addSecondarySample(voxel, range);
-    secondary_sample_buffer.writeVoxel(voxel_index, voxel);
+      secondary_sample_buffer.readVoxel(voxel_index, &voxel);
+      addSecondarySample(voxel, range);
+      secondary_sample_buffer.writeVoxel(voxel_index, voxel);
+    }
 
-    assert(chunk);
-    chunk->dirty_stamp = touch_stamp;
+    chunk->markDirty(touch_stamp);
     chunk->touched_stamps[secondary_samples_layer].store(touch_stamp, std::memory_order_relaxed);
+  };
+
+  const size_t sample_count = element_count / 2;
+  for (size_t batch_start = 0; batch_start < sample_count; batch_start += RayBatch::kDefaultBatchSize)
+  {
+    const size_t batch_end = std::min(batch_start + RayBatch::kDefaultBatchSize, sample_count);
+    batch_.clear();
+    batch_.reserve(batch_end - batch_start);
+
+    for (size_t i = batch_start; i < batch_end; ++i)
+    {
+      batch_.addRay(rays[i * 2 + 0], rays[i * 2 + 1], i, 0u, kRbSample);
+    }
+
+    batch_.build(*map_);
+    batch_.forEachRegion(update_region);
   }
 
-  return element_count / 2;
+  return sample_count;
 }
 }  // namespace ohm
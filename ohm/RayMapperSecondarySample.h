@@ -9,6 +9,7 @@
 
 #include "CalculateSegmentKeys.h"
 #include "KeyList.h"
+#include "RayBatch.h"
 #include "RayFilter.h"
 #include "RayFlag.h"
 #include "RayMapper.h"
@@ -26,7 +27,8 @@ namespace ohm
 /// are expected to originate from the previous/primary voxel to the secondary voxel instead of from the sensor.
 /// Intensity and timestamp values are ignored. @c RayFlag values have no effect.
 ///
-/// The @c integrateRays() implementation performs a single threaded walk of just the sample voxels.
+/// The @c integrateRays() implementation performs a single threaded update of just the sample voxels, grouped by
+/// region using a @c RayBatch .
 class ohm_API RayMapperSecondarySample : public RayMapper
 {
 public:
@@ -65,7 +67,9 @@ protected:
   OccupancyMap *map_ = nullptr;       ///< Target map.
   int secondary_samples_layer_ = -1;  ///< Cached secondary samples layer index.
   glm::u8vec3 layer_dim_{ 0, 0, 0 };  ///< Cached layer voxel dimensions.
+  VoxelOrder layer_order_ = VoxelOrder::kRowMajor;  ///< Cached layer voxel order.
   bool valid_ = false;                ///< Has layer validation passed?
+  RayBatch batch_;                    ///< Ray batching helper.
 };
 
 }  // namespace ohm
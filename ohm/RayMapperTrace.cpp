@@ -12,6 +12,7 @@
 #include "MapRegionCache.h"
 #include "OccupancyMap.h"
 #include "Trace.h"
+#include "TraceCapture.h"
 #include "VoxelData.h"
 
 #include "private/OccupancyMapDetail.h"
@@ -631,38 +632,116 @@ bool RayMapperTrace::valid() const
   return true_mapper_ != nullptr && true_mapper_->valid();
 }
 
+void RayMapperTrace::setRegionOfInterest(const Aabb &roi)
+{
+  roi_ = roi;
+  have_roi_ = true;
+}
+
+
+void RayMapperTrace::clearRegionOfInterest()
+{
+  have_roi_ = false;
+}
+
+
+bool RayMapperTrace::openCapture(const std::string &filename, bool with_rays)
+{
+  if (!capture_)
+  {
+    capture_ = std::make_unique<TraceCaptureWriter>();
+  }
+  return capture_->open(filename, *map_, with_rays);
+}
+
+
+void RayMapperTrace::closeCapture()
+{
+  if (capture_)
+  {
+    capture_->close();
+  }
+}
+
+
+bool RayMapperTrace::captureOpen() const
+{
+  return capture_ && capture_->isOpen();
+}
+
+
 size_t RayMapperTrace::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
                                      const double *timestamps, unsigned ray_update_flags)
 {
+  const uint64_t batch_index = batch_count_++;
+  bool live = false;
 #ifdef TES_ENABLE
+  live = live_emission_ && g_tes;
+#endif  // TES_ENABLE
+  const bool capture = captureOpen();
+
+  // Select the rays to trace for sampled batches.
+  const glm::dvec3 *traced_rays = nullptr;
+  size_t traced_count = 0;
+  if ((live || capture) && element_count && batch_interval_ && batch_index % batch_interval_ == 0)
+  {
+    traced_rays = selectRays(rays, element_count, &traced_count);
+  }
+
+  if (traced_count == 0)
+  {
+    // Not tracing this batch.
+    return true_mapper_->integrateRays(rays, element_count, intensities, timestamps, ray_update_flags);
+  }
+
   // Walk all the rays and cache the state of the (predicted) touched voxels.
   VoxelMap initial_state;
   VoxelMap updated_state;
   SectorSet sector_set;
 
-  if (g_tes && element_count)
+  cacheState(traced_rays, traced_count, &initial_state, (live) ? &sector_set : nullptr);
+
+  const size_t result = true_mapper_->integrateRays(rays, element_count, intensities, timestamps, ray_update_flags);
+
+  // Sync gpu cache to CPU
+  if (map_->detail()->gpu_cache)
   {
-    cacheState(rays, element_count, &initial_state, &sector_set);
+    map_->detail()->gpu_cache->flush();
   }
-#endif  // TES_ENABLE
 
-  const size_t result = true_mapper_->integrateRays(rays, element_count, intensities, timestamps, ray_update_flags);
+  cacheState(traced_rays, traced_count, &updated_state);
 
-#ifdef TES_ENABLE
-  if (g_tes && element_count)
+  if (capture)
   {
-    // Sync gpu cache to CPU
-    if (map_->detail()->gpu_cache)
+    // Record the changed voxels only.
+    std::vector<TraceCaptureVoxel> changes;
+    for (const auto &voxel_info : updated_state)
     {
-      map_->detail()->gpu_cache->flush();
+      const auto initial_info = initial_state.find(voxel_info.first);
+      const OccupancyType initial_type = (initial_info != initial_state.end()) ? initial_info->second.type : kNull;
+      if (initial_info == initial_state.end() || voxel_info.second.type != initial_type ||
+          voxel_info.second.occupancy != initial_info->second.occupancy)
+      {
+        TraceCaptureVoxel change;
+        change.key = voxel_info.first;
+        change.occupancy = voxel_info.second.occupancy;
+        change.initial_type = initial_type;
+        change.type = voxel_info.second.type;
+        changes.emplace_back(change);
+      }
     }
 
-    // Draw the rays
-    g_tes->create(tes::MeshShape(tes::DtLines, tes::Id(0u, kTcRays),
-                                 tes::DataBuffer(&rays->x, element_count, 3, sizeof(*rays) / sizeof(rays->x)))
-                    .setColour(tes::Colour::Colours[tes::Colour::Yellow]));
+    capture_->push(batch_index, traced_rays, traced_count, changes);
+  }
 
-    cacheState(rays, element_count, &updated_state);
+#ifdef TES_ENABLE
+  if (live)
+  {
+    // Draw the rays
+    g_tes->create(
+      tes::MeshShape(tes::DtLines, tes::Id(0u, kTcRays),
+                     tes::DataBuffer(&traced_rays->x, traced_count, 3, sizeof(*traced_rays) / sizeof(traced_rays->x)))
+        .setColour(tes::Colour::Colours[tes::Colour::Yellow]));
 
     // Determine changes.
     KeySet newly_occupied;
@@ -733,6 +812,32 @@ size_t RayMapperTrace::integrateRays(const glm::dvec3 *rays, size_t element_coun
 }
 
 
+const glm::dvec3 *RayMapperTrace::selectRays(const glm::dvec3 *rays, size_t element_count, size_t *element_count_out)
+{
+  if (!have_roi_)
+  {
+    *element_count_out = element_count;
+    return rays;
+  }
+
+  traced_rays_.clear();
+  for (size_t i = 0; i + 1 < element_count; i += 2)
+  {
+    glm::dvec3 start = rays[i];
+    glm::dvec3 end = rays[i + 1];
+    // Keep rays inside the ROI as is and clip those which cross it.
+    if ((roi_.contains(start) && roi_.contains(end)) || roi_.clipLine(start, end, nullptr, true))
+    {
+      traced_rays_.emplace_back(start);
+      traced_rays_.emplace_back(end);
+    }
+  }
+
+  *element_count_out = traced_rays_.size();
+  return traced_rays_.data();
+}
+
+
 glm::i16vec4 RayMapperTrace::sectorKey(const Key &key) const
 {
   // We divide the MapChunk into 8 sectors, like a voxel. We need to convert the local key into a sector index
@@ -752,45 +857,50 @@ glm::i16vec4 RayMapperTrace::sectorKey(const Key &key) const
 void RayMapperTrace::cacheState(const glm::dvec3 *rays, size_t element_count, VoxelMap *voxels, SectorSet *sectors)
 {
   KeyList keys;
+  KeyList ray_keys;
+
+  // Collect the unique keys for all rays first. Rays share many voxels, so this saves repeated lookups.
+  for (size_t ri = 0; ri < element_count / 2; ++ri)
+  {
+    calculateSegmentKeys(ray_keys, *map_, rays[ri * 2 + 0], rays[ri * 2 + 1], true);
+    keys.append(ray_keys);
+  }
+  keys.sortUnique(map_->regionVoxelDimensions());
+  voxels->reserve(voxels->size() + keys.size());
 
   // Setup voxel references
   Voxel<const float> occupancy_voxel(map_, map_->layout().occupancyLayer());
   Voxel<const VoxelMean> mean_voxel(map_, map_->layout().meanLayer());
   Voxel<const CovarianceVoxel> covariance_voxel(map_, map_->layout().covarianceLayer());
 
-  for (size_t ri = 0; ri < element_count / 2; ++ri)
+  // Walk the keys: the keys of each region are contiguous, so the voxel references stay in the same chunk.
+  for (const auto &key : keys)
   {
-    keys.clear();
-    calculateSegmentKeys(keys, *map_, rays[ri * 2 + 0], rays[ri * 2 + 1], true);
-
-    // Walk the ray keys
-    for (const auto &key : keys)
+    if (sectors)
     {
-      if (sectors)
-      {
-        sectors->insert(sectorKey(key));
-      }
-
-      if (voxels->find(key) == voxels->end())
-      {
-        // not already in the set.
-        setVoxelKey(key, occupancy_voxel, mean_voxel, covariance_voxel);
+      sectors->insert(sectorKey(key));
+    }
 
-        VoxelState voxel_info;
-        voxel_info.type = occupancyType(occupancy_voxel);
+    setVoxelKey(key, occupancy_voxel, mean_voxel, covariance_voxel);
 
-        if (voxel_info.type == kOccupied && covariance_voxel.isValid() && mean_voxel.isValid())
-        {
-          CovarianceVoxel cov;
-          covariance_voxel.read(&cov);
+    VoxelState voxel_info;
+    voxel_info.type = occupancyType(occupancy_voxel);
+    voxel_info.occupancy = unobservedOccupancyValue();
+    if (occupancy_voxel.isValid())
+    {
+      occupancy_voxel.read(&voxel_info.occupancy);
+    }
 
-          voxel_info.ellipse_pos = positionUnsafe(mean_voxel);
-          covarianceUnitSphereTransformation(&cov, &voxel_info.ellipse_rotation, &voxel_info.ellipse_scale);
-        }
+    if (voxel_info.type == kOccupied && covariance_voxel.isValid() && mean_voxel.isValid())
+    {
+      CovarianceVoxel cov;
+      covariance_voxel.read(&cov);
 
-        voxels->insert(std::make_pair(key, voxel_info));
-      }
+      voxel_info.ellipse_pos = positionUnsafe(mean_voxel);
+      covarianceUnitSphereTransformation(&cov, &voxel_info.ellipse_rotation, &voxel_info.ellipse_scale);
     }
+
+    voxels->insert(std::make_pair(key, voxel_info));
   }
 }
 }  // namespace ohm
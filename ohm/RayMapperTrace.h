@@ -8,6 +8,7 @@
 
 #include "OhmConfig.h"
 
+#include "Aabb.h"
 #include "Key.h"
 #include "OccupancyType.h"
 #include "RayMapper.h"
@@ -19,12 +20,16 @@
 
 #include <glm/gtc/quaternion.hpp>
 
+#include <memory>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace ohm
 {
 class OccupancyMesh;
+class TraceCaptureWriter;
 
 /// A @c RayMapper wrapper which adds Third Eye Scene debug visualisation to the process.
 ///
@@ -34,6 +39,12 @@ class OccupancyMesh;
 ///
 /// The visualisation shows rays being integrated, occupied voxels and NDT ellipsoids if present.
 ///
+/// The overhead may be reduced by sampling: only every @c batchInterval() batch is traced and the trace may be
+/// restricted to a @c regionOfInterest() . Live 3rd Eye Scene emission may also be replaced by a binary capture
+/// written from a background thread - see @c openCapture() and @c TraceCaptureWriter . The capture records the
+/// changed voxels of each traced batch and does not require @c OHM_TES_DEBUG . Untraced batches are passed directly to
+/// the @c trueMapper() .
+///
 /// See https://github.com/csiro-robotics/3rdEyeScene
 class ohm_API RayMapperTrace : public RayMapper
 {
@@ -44,6 +55,7 @@ public:
     glm::dquat ellipse_rotation{ 1, 0, 0, 0 };  ///< Rotation applied to a scaled sphere to generate the ellipse.
     glm::dvec3 ellipse_pos{ 0 };                ///< Global position of the voxel ellipse.
     glm::dvec3 ellipse_scale{ 1 };              ///< Ellipse scaling.
+    float occupancy{ 0 };                       ///< Voxel occupancy value.
     OccupancyType type{ kNull };                ///< Voxel type.
   };
 
@@ -95,6 +107,50 @@ public:
   /// @return The wrapped mapper.
   inline RayMapper *trueMapper() const { return true_mapper_; }
 
+  /// Set the batch sampling interval. Only every Nth call to @c integrateRays() is traced, starting with the first.
+  /// Zero disables tracing.
+  /// @param interval The batch interval. Default is 1 to trace every batch.
+  inline void setBatchInterval(unsigned interval) { batch_interval_ = interval; }
+  /// Query the batch sampling interval.
+  /// @return The batch interval.
+  inline unsigned batchInterval() const { return batch_interval_; }
+
+  /// Restrict the trace to rays intersecting @p roi . Rays are clipped to the @p roi for tracing, but are integrated
+  /// unmodified. Batches with no rays in the @p roi are not traced.
+  /// @param roi The region of interest.
+  void setRegionOfInterest(const Aabb &roi);
+  /// Clear the @c regionOfInterest() to trace all rays.
+  void clearRegionOfInterest();
+  /// Query the region of interest. Only relevant when @c hasRegionOfInterest() .
+  /// @return The region of interest.
+  inline const Aabb &regionOfInterest() const { return roi_; }
+  /// Query if a @c regionOfInterest() is set.
+  /// @return True if tracing is restricted to the @c regionOfInterest() .
+  inline bool hasRegionOfInterest() const { return have_roi_; }
+
+  /// Enable or disable live 3rd Eye Scene emission. This has no effect unless built with @c OHM_TES_DEBUG .
+  /// @param enable True to enable live emission (default).
+  inline void setLiveEmission(bool enable) { live_emission_ = enable; }
+  /// Query if live 3rd Eye Scene emission is enabled.
+  /// @return True if live emission is enabled.
+  inline bool liveEmission() const { return live_emission_; }
+
+  /// Open a binary capture at @p filename recording the voxel changes of each traced batch. See
+  /// @c TraceCaptureWriter for the format and @c TraceCaptureReader to read the capture.
+  /// @param filename The capture file path.
+  /// @param with_rays Include the traced rays in the capture?
+  /// @return True on success.
+  bool openCapture(const std::string &filename, bool with_rays = true);
+  /// Flush and close the capture file.
+  void closeCapture();
+  /// Query if a capture file is open.
+  /// @return True if capturing.
+  bool captureOpen() const;
+
+  /// Query the number of @c integrateRays() calls made so far, traced or not.
+  /// @return The batch count.
+  inline uint64_t batchCount() const { return batch_count_; }
+
   /// Validity check - passthrough to the wrapped mapper.
   /// @return True if the wrapped mapper is valid.
   bool valid() const override;
@@ -119,9 +175,24 @@ private:
   /// Cache the initial state of voxels affected by the given @p ray set.
   void cacheState(const glm::dvec3 *rays, size_t element_count, VoxelMap *voxels, SectorSet *sectors = nullptr);
 
+  /// Select the rays to trace for the current batch, clipping to the @c regionOfInterest() when set.
+  /// @param rays The batch rays.
+  /// @param element_count The number of elements in @p rays .
+  /// @param[out] element_count_out Set to the number of elements in the returned ray array.
+  /// @return The rays to trace: either @p rays or @c traced_rays_ .
+  const glm::dvec3 *selectRays(const glm::dvec3 *rays, size_t element_count, size_t *element_count_out);
+
   OccupancyMap *map_;
   RayMapper *true_mapper_;
   std::unique_ptr<OccupancyMesh> imp_;
+  std::unique_ptr<TraceCaptureWriter> capture_;
+  /// Ray buffer used to clip rays to the @c roi_ .
+  std::vector<glm::dvec3> traced_rays_;
+  Aabb roi_{ 0.0 };
+  uint64_t batch_count_ = 0;
+  unsigned batch_interval_ = 1;
+  bool have_roi_ = false;
+  bool live_emission_ = true;
 };
 }  // namespace ohm
 
@@ -10,11 +10,16 @@
 #include "MapChunk.h"
 #include "MapLayer.h"
 #include "MapLayout.h"
+#include "Metrics.h"
 #include "OccupancyMap.h"
 #include "Voxel.h"
 #include "VoxelBuffer.h"
 #include "VoxelTsdf.h"
 
+#include <ohmutil/Profile.h>
+
+#include <algorithm>
+
 namespace ohm
 {
 RayMapperTsdf::RayMapperTsdf(OccupancyMap *map)
@@ -27,6 +32,7 @@ RayMapperTsdf::RayMapperTsdf(OccupancyMap *map)
   Voxel<const VoxelTsdf> tsdf(map_, tsdf_layer_);
 
   tsdf_dim_ = tsdf.isLayerValid() ? tsdf.layerDim() : tsdf_dim_;
+  tsdf_order_ = tsdf.isLayerValid() ? tsdf.layerVoxelOrder() : tsdf_order_;
   valid_ = tsdf.isLayerValid();
 }
 
@@ -34,6 +40,22 @@ RayMapperTsdf::RayMapperTsdf(OccupancyMap *map)
 RayMapperTsdf::~RayMapperTsdf() = default;
 
 
+void RayMapperTsdf::setUseThreads(bool use_threads)
+{
+  use_threads_ = use_threads;
+}
+
+
+bool RayMapperTsdf::useThreads() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return use_threads_;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
 void RayMapperTsdf::setTsdfOptions(const TsdfOptions &options)
 {
   tsdf_options_ = options;
@@ -87,97 +109,86 @@ void RayMapperTsdf::setSparsityCompensationFactor(float sparsity_compensation_fa
 size_t RayMapperTsdf::integrateRays(const glm::dvec3 *rays, size_t element_count, const float * /*intensities*/,
                                     const double *timestamps, unsigned /*ray_update_flags*/)
 {
-  KeyList keys;
-  MapChunk *last_chunk = nullptr;
-  VoxelBuffer<VoxelBlock> tsdf_buffer;
-
-  const RayFilterFunction ray_filter = map_->rayFilter();
-  const bool use_filter = bool(ray_filter);
+  PROFILE(RayMapperTsdf_integrateRays);
+  const bool use_threads = useThreads();
   const auto tsdf_layer = tsdf_layer_;
   const auto tsdf_dim = tsdf_dim_;
+  const auto tsdf_order = tsdf_order_;
   // Touch the map to flag changes.
   const auto touch_stamp = map_->touch();
 
-  // Cached values for current ray to use in the update closure.
-  glm::dvec3 sensor{};
-  glm::dvec3 sample{};
-  // Filtered start/end points.
-  glm::dvec3 ray_start{};
-  glm::dvec3 ray_end{};
-
   if (timestamps)
   {
     // Update first ray time if not yet set.
     map_->updateFirstRayTime(*timestamps);
   }
 
-  const auto visit_func = [&](const Key &key, double enter_range, double exit_range) -> bool  //
+  // Update the voxels in a single region. The voxel buffer is loaded once per region. Regions may be updated
+  // concurrently, but each region is only visited by one thread.
+  const auto update_region = [&](const RayBatchRegion &region, const RayBatchVoxel *voxels, size_t voxel_count)  //
   {
-    (void)enter_range;  // Unused
-    (void)exit_range;   // Unused
-    // The update logic here is a little unclear as it tries to avoid outright branches.
-    // The intended logic is described as follows:
-    // 1. Select direct write or additive adjustment.
-    //    - Make a direct, non-additive adjustment if one of the following conditions are met:
-    //      - stop_adjustments is true
-    //      - the voxel is uncertain
-    //      - ray_update_flags and kRfExclude<Type> flags pass.
-    //      - voxel is saturated
-    //    - Otherwise add to present value.
-    // 2. Select the value adjustment
-    //    - current_value if one of the following conditions are met:
-    //      - stop_adjustments is true (no longer making adjustments)
-    //      - ray_update_flags and kRfExclude<Type> flags pass.
-    //    - miss_value otherwise
-    // 3. Calculate new value
-    // 4. Apply saturation logic: only min saturation relevant
-    //    -
-    MapChunk *chunk =
-      (last_chunk && key.regionKey() == last_chunk->region.coord) ? last_chunk : map_->region(key.regionKey(), true);
-    if (chunk != last_chunk)
+    MapChunk *chunk = region.chunk;
+    VoxelBuffer<VoxelBlock> tsdf_buffer(chunk->voxel_blocks[tsdf_layer]);
+    for (size_t v = 0; v < voxel_count; ++v)
     {
-      tsdf_buffer = VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[tsdf_layer]);
+      const RayBatchVoxel &voxel = voxels[v];
+      // The TSDF update uses the unfiltered ray.
+      const size_t ray_index = batch_.rays()[voxel.ray_index].source_index;
+      const glm::dvec3 &sensor = rays[ray_index * 2 + 0];
+      const glm::dvec3 &sample = rays[ray_index * 2 + 1];
+      const unsigned voxel_index = ohm::voxelIndex(voxel.key, tsdf_dim, tsdf_order);
+      VoxelTsdf tsdf_voxel;
+      tsdf_buffer.readVoxel(voxel_index, &tsdf_voxel);
+
+      calculateTsdf(sensor, sample, map_->voxelCentreGlobal(voxel.key), tsdf_options_.default_truncation_distance,
+                    tsdf_options_.max_weight, tsdf_options_.dropoff_epsilon,
+                    tsdf_options_.sparsity_compensation_factor, &tsdf_voxel.weight, &tsdf_voxel.distance);
+      tsdf_buffer.writeVoxel(voxel_index, tsdf_voxel);
+
+      // Lint(KS): The analyser takes some branches which are not possible in practice.
+      // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
+      chunk->updateFirstValid(voxel.key.localKey(), tsdf_dim);
     }
-    last_chunk = chunk;
-    const unsigned voxel_index = ohm::voxelIndex(key, tsdf_dim);
-    VoxelTsdf tsdf_voxel;
-    tsdf_buffer.readVoxel(voxel_index, &tsdf_voxel);
-
-    calculateTsdf(sensor, sample, map_->voxelCentreGlobal(key), tsdf_options_.default_truncation_distance,
-                  tsdf_options_.max_weight, tsdf_options_.dropoff_epsilon, tsdf_options_.sparsity_compensation_factor,
-                  &tsdf_voxel.weight, &tsdf_voxel.distance);
-    tsdf_buffer.writeVoxel(voxel_index, tsdf_voxel);
 
-    // Lint(KS): The analyser takes some branches which are not possible in practice.
-    // NOLINTNEXTLINE(clang-analyzer-core.CallAndMessage)
-    chunk->updateFirstValid(voxel_index);
-
-    chunk->dirty_stamp = touch_stamp;
+    chunk->markDirty(touch_stamp);
     // Update the touched_stamps with relaxed memory ordering. The important thing is to have an update,
     // not so much the sequencing. We really don't want to synchronise here.
     chunk->touched_stamps[tsdf_layer].store(touch_stamp, std::memory_order_relaxed);
-
-    return true;
   };
 
-  for (size_t i = 0; i < element_count; i += 2)
+  const size_t ray_count = element_count / 2;
+  size_t filtered_count = 0;
+  for (size_t batch_start = 0; batch_start < ray_count; batch_start += RayBatch::kDefaultBatchSize)
   {
-    unsigned filter_flags = 0;
-    ray_start = sensor = rays[i];
-    ray_end = sample = rays[i + 1];
+    const size_t batch_end = std::min(batch_start + RayBatch::kDefaultBatchSize, ray_count);
+    batch_.clear();
+    batch_.reserve(batch_end - batch_start);
 
-    if (use_filter)
+    // Filter the whole batch in a separate pass.
+    filtered_rays_.assign(rays + batch_start * 2, rays + batch_end * 2);
+    filter_flags_.resize(batch_end - batch_start);
+    filtered_count += filterRays(filtered_rays_.data(), filter_flags_.data(), batch_end - batch_start,
+                                 map_->rayBatchFilter(), map_->rayFilter());
+
+    for (size_t i = batch_start; i < batch_end; ++i)
     {
-      if (!ray_filter(&ray_start, &ray_end, &filter_flags))
+      if (filter_flags_[i - batch_start] & kRffInvalid)
       {
         // Bad ray.
         continue;
       }
+
+      batch_.addRay(filtered_rays_[(i - batch_start) * 2 + 0], filtered_rays_[(i - batch_start) * 2 + 1], i, 0u,
+                    kRbWalk);
     }
 
-    walkSegmentKeys(LineWalkContext(*map_, visit_func), ray_start, ray_end);
+    batch_.build(*map_, use_threads);
+    batch_.forEachRegion(update_region, use_threads);
   }
 
-  return element_count / 2;
+  const metrics::CoreMetrics &core_metrics = metrics::coreMetrics();
+  core_metrics.rays_integrated.add(ray_count);
+  core_metrics.rays_filtered.add(filtered_count);
+  return ray_count;
 }
 }  // namespace ohm
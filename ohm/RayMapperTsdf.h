@@ -10,6 +10,7 @@
 
 #include "CalculateSegmentKeys.h"
 #include "KeyList.h"
+#include "RayBatch.h"
 #include "RayFilter.h"
 #include "RayFlag.h"
 #include "RayMapper.h"
@@ -18,14 +19,19 @@
 
 #include <glm/vec3.hpp>
 
+#include <vector>
+
 namespace ohm
 {
 /// A @c RayMapper implementation built around updating a TSDF map in CPU. This mapper supports TSDF
 /// population of @c VoxelTsdf .
 ///
-/// The @c integrateRays() implementation performs a single threaded walk of the voxels to update and touches
-/// those voxels one at a time, updating their tsdf values. The given @c OccupancyMap must have a @c VoxelTsdf
-/// layer.
+/// The @c integrateRays() implementation walks the voxels to update using a @c RayBatch and touches those voxels one
+/// region at a time, updating their tsdf values. The given @c OccupancyMap must have a @c VoxelTsdf layer.
+///
+/// When built with @c OHM_FEATURE_THREADS , a multi-threaded update may be enabled via @c setUseThreads() . Each
+/// region is then owned by a single thread which applies the region's updates in ray order, so the results exactly
+/// match the single threaded update.
 class ohm_API RayMapperTsdf : public RayMapper
 {
 public:
@@ -41,6 +47,14 @@ public:
   /// @return True if valid and @c integrateRays() is safe to call.
   inline bool valid() const override { return valid_; }
 
+  /// Enable or disable multi-threaded ray integration. Ignored unless built with @c OHM_FEATURE_THREADS .
+  /// @param use_threads True to enable threaded integration.
+  void setUseThreads(bool use_threads);
+
+  /// Is multi-threaded ray integration enabled? Always false when not built with @c OHM_FEATURE_THREADS .
+  /// @return True if threaded integration is enabled and available.
+  bool useThreads() const;
+
   void setTsdfOptions(const TsdfOptions &options);
   const TsdfOptions &tsdfOptions() const { return tsdf_options_; }
 
@@ -55,8 +69,13 @@ public:
 
   /// Performs the ray integration.
   ///
-  /// This is updated in a single threaded fashion. For each ray we walk the affected voxel @c Key set and
-  /// update those voxels. Voxels along each line segment have their tsdf value updated.
+  /// Rays are processed in batches using a @c RayBatch . For each batch we walk the affected voxel @c Key set for each
+  /// ray, group the voxels by region and update each region in turn. Voxels along each line segment have their tsdf
+  /// value updated.
+  ///
+  /// When @c useThreads() is set, the ray segments are walked in parallel and the regions are updated in parallel.
+  /// The update of each voxel depends only on the voxel and the ray, and each region applies its updates in ray order,
+  /// so the results are identical to the single threaded update.
   ///
   /// Should only be called if @c valid() is true.
   ///
@@ -78,8 +97,13 @@ protected:
   OccupancyMap *map_ = nullptr;      ///< Target map.
   int tsdf_layer_ = -1;              ///< Cached tsdf layer index.
   glm::u8vec3 tsdf_dim_{ 0, 0, 0 };  ///< Cached tsdf layer voxel dimensions. Voxel mean must exactly match.
+  VoxelOrder tsdf_order_ = VoxelOrder::kRowMajor;  ///< Cached tsdf layer voxel order.
   TsdfOptions tsdf_options_;         ///< TSDF options.
   bool valid_ = false;               ///< Has layer validation passed?
+  bool use_threads_ = false;         ///< Use multi-threaded integration (if available)?
+  RayBatch batch_;                   ///< Ray batching helper.
+  std::vector<glm::dvec3> filtered_rays_;  ///< Rays after the filter pass.
+  std::vector<unsigned> filter_flags_;     ///< @c RayFilterFlag values for each of the @c filtered_rays_ .
 };
 
 }  // namespace ohm
@@ -8,18 +8,264 @@
 #include "private/RaysQueryDetail.h"
 
 #include "CalculateSegmentKeys.h"
+#include "CompactRays.h"
 #include "KeyList.h"
 #include "LineWalk.h"
+#include "MapChunk.h"
 #include "MapLayer.h"
 #include "MapLayout.h"
 #include "OccupancyMap.h"
+#include "TaskArena.h"
 #include "Voxel.h"
 #include "VoxelBuffer.h"
 #include "VoxelMean.h"
 #include "VoxelOccupancy.h"
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <unordered_set>
+
 namespace ohm
 {
+namespace
+{
+/// Evaluate the rays with indices in `[begin, end)`, writing results directly into the pre-sized output arrays.
+///
+/// All mutable state, including the cached @c VoxelBuffer , is local to this call so disjoint ray ranges may be
+/// evaluated concurrently.
+///
+/// When @p ray_indices is given, the rays evaluated are `ray_indices[begin, end)` instead. When @p ray_regions is
+/// given, the regions traversed by each ray are recorded in the matching element of @p ray_regions .
+void raysQueryRange(RaysQueryDetail &d, size_t begin, size_t end, const size_t *ray_indices = nullptr,
+                    std::vector<std::vector<glm::i16vec3>> *ray_regions = nullptr)
+{
+  MapChunk *last_chunk = nullptr;
+  VoxelBuffer<const VoxelBlock> occupancy_buffer;
+  double unobserved_volume = 0;
+  float range = 0;
+  OccupancyType terminal_state = OccupancyType::kNull;
+  Key terminal_key(nullptr);
+  std::vector<glm::i16vec3> *traversed_regions = nullptr;
+
+  auto *map = d.map;
+  const RayFilterFunction ray_filter = map->rayFilter();
+  const bool use_filter = bool(ray_filter);
+  const auto occupancy_layer = d.occupancy_layer;
+  const auto occupancy_dim = d.occupancy_dim;
+  const auto occupancy_order = d.occupancy_order;
+  const auto occupancy_threshold_value = map->occupancyThresholdValue();
+  const auto volume_coefficient = d.volume_coefficient;
+
+  const auto visit_func = [&](const Key &key, double enter_range, double exit_range) -> bool  //
+  {
+    if (traversed_regions && (traversed_regions->empty() || traversed_regions->back() != key.regionKey()))
+    {
+      traversed_regions->emplace_back(key.regionKey());
+    }
+    // Work out the index of the voxel in it's region.
+    const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim, occupancy_order);
+    float occupancy_value = unobservedOccupancyValue();
+    // Ensure the MapChunk pointer is up to date.
+    MapChunk *chunk =
+      (last_chunk && key.regionKey() == last_chunk->region.coord) ? last_chunk : map->region(key.regionKey(), false);
+    if (chunk)
+    {
+      if (chunk != last_chunk)
+      {
+        occupancy_buffer = VoxelBuffer<const VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
+      }
+      occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
+    }
+    last_chunk = chunk;
+    // Check voxel occupancy status.
+    const bool is_unobserved = occupancy_value == unobservedOccupancyValue();
+    const bool is_occupied = !is_unobserved && occupancy_value > occupancy_threshold_value;
+    unobserved_volume +=
+      is_unobserved ?
+        (volume_coefficient * (exit_range * exit_range * exit_range - enter_range * enter_range * enter_range)) :
+        0.0f;
+    range = (!is_occupied) ? float(exit_range) : range;
+    // Resolve the voxel state.
+    terminal_state =
+      is_unobserved ? OccupancyType::kUnobserved : (is_occupied ? OccupancyType::kOccupied : OccupancyType::kFree);
+    terminal_key = key;
+
+    return !is_occupied;
+  };
+
+  glm::dvec3 start;
+  glm::dvec3 end_point;
+  unsigned filter_flags;
+  for (size_t index = begin; index < end; ++index)
+  {
+    const size_t i = (ray_indices) ? ray_indices[index] : index;
+    filter_flags = 0;
+    start = d.rays_in[i * 2 + 0];
+    end_point = d.rays_in[i * 2 + 1];
+
+    unobserved_volume = 0.0f;
+    range = 0.0f;
+    if (ray_regions)
+    {
+      traversed_regions = &(*ray_regions)[i];
+      traversed_regions->clear();
+    }
+
+    if (use_filter && !ray_filter(&start, &end_point, &filter_flags))
+    {
+      // Filtered ray.
+      d.ranges[i] = range;
+      d.unobserved_volumes_out[i] = unobserved_volume;
+      d.terminal_states_out[i] = OccupancyType::kNull;
+      d.intersected_voxels[i] = Key::kNull;
+      continue;
+    }
+
+    walkSegmentKeys(LineWalkContext(*map, visit_func), start, end_point);
+
+    d.ranges[i] = range;
+    d.unobserved_volumes_out[i] = unobserved_volume;
+    d.terminal_states_out[i] = terminal_state;
+    d.intersected_voxels[i] = terminal_key;
+  }
+}
+
+
+/// Evaluate the rays in @p d , partitioning the rays across TBB workers when @p use_threads is set.
+///
+/// @param d Query details.
+/// @param use_threads Allow the use of multiple threads?
+/// @param ray_indices When given, only these rays are evaluated. Otherwise all rays are evaluated.
+/// @param ray_regions When given, records the regions traversed by each ray - see @c raysQueryRange() .
+void evaluateRays(RaysQueryDetail &d, bool use_threads, const std::vector<size_t> *ray_indices = nullptr,
+                  std::vector<std::vector<glm::i16vec3>> *ray_regions = nullptr)
+{
+  const size_t count = (ray_indices) ? ray_indices->size() : d.rays_in.size() / 2;
+  const size_t *indices = (ray_indices) ? ray_indices->data() : nullptr;
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, count), [&](const tbb::blocked_range<size_t> &range) {
+        raysQueryRange(d, range.begin(), range.end(), indices, ray_regions);
+      });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    raysQueryRange(d, 0, count, indices, ray_regions);
+  }
+  d.evaluated_ray_count = count;
+}
+
+
+/// Current @c MapChunk::dirty_stamp for @p region_key , or zero if the region does not exist.
+uint64_t regionStamp(const OccupancyMap &map, const glm::i16vec3 &region_key)
+{
+  const MapChunk *chunk = map.region(region_key);
+  return (chunk) ? chunk->dirty_stamp.load() : 0u;
+}
+
+
+/// Evaluate an incremental query, reusing the cached results of rays for which none of the traversed regions have
+/// changed since they were cached.
+void raysQueryIncremental(RaysQueryDetail &d, bool use_threads)
+{
+  RaysQueryCache &cache = d.cache;
+  const size_t ray_count = d.rays_in.size() / 2;
+  const size_t cached_count = std::min(cache.size(), ray_count);
+
+  // Resolve the regions which have changed since the results were cached.
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> changed_regions;
+  for (const auto &region_stamp : cache.region_stamps)
+  {
+    if (regionStamp(*d.map, region_stamp.first) != region_stamp.second)
+    {
+      changed_regions.insert(region_stamp.first);
+    }
+  }
+
+  // Select cached rays which traverse a changed region and all uncached rays.
+  std::vector<size_t> dirty_rays;
+  for (size_t i = 0; i < cached_count; ++i)
+  {
+    const std::vector<glm::i16vec3> &regions = cache.ray_regions[i];
+    if (!changed_regions.empty() && std::any_of(regions.begin(), regions.end(), [&](const glm::i16vec3 &region_key) {
+          return changed_regions.find(region_key) != changed_regions.end();
+        }))
+    {
+      dirty_rays.emplace_back(i);
+    }
+  }
+  for (size_t i = cached_count; i < ray_count; ++i)
+  {
+    dirty_rays.emplace_back(i);
+  }
+
+  // Start from the cached results and update the dirty rays.
+  cache.ranges.resize(ray_count);
+  cache.intersected_voxels.resize(ray_count);
+  cache.unobserved_volumes.resize(ray_count);
+  cache.terminal_states.resize(ray_count);
+  cache.ray_regions.resize(ray_count);
+  d.ranges = cache.ranges;
+  d.intersected_voxels = cache.intersected_voxels;
+  d.unobserved_volumes_out = cache.unobserved_volumes;
+  d.terminal_states_out = cache.terminal_states;
+
+  evaluateRays(d, use_threads, &dirty_rays, &cache.ray_regions);
+
+  if (!dirty_rays.empty())
+  {
+    cache.ranges = d.ranges;
+    cache.intersected_voxels = d.intersected_voxels;
+    cache.unobserved_volumes = d.unobserved_volumes_out;
+    cache.terminal_states = d.terminal_states_out;
+
+    // Record the current stamps of the regions traversed by the dirty rays. Stamps for other regions are unchanged.
+    for (const size_t ray_index : dirty_rays)
+    {
+      for (const glm::i16vec3 &region_key : cache.ray_regions[ray_index])
+      {
+        cache.region_stamps[region_key] = regionStamp(*d.map, region_key);
+      }
+    }
+  }
+}
+
+
+/// Evaluate all the rays in @p d , partitioning the rays across TBB workers when @p use_threads is set.
+bool raysQueryCpu(RaysQueryDetail &d, bool use_threads)
+{
+  const size_t ray_count = d.rays_in.size() / 2;
+
+  if (d.incremental)
+  {
+    raysQueryIncremental(d, use_threads);
+  }
+  else
+  {
+    // Size the output arrays so each worker writes only its own elements.
+    d.ranges.resize(ray_count);
+    d.intersected_voxels.resize(ray_count);
+    d.unobserved_volumes_out.resize(ray_count);
+    d.terminal_states_out.resize(ray_count);
+    evaluateRays(d, use_threads);
+  }
+
+  d.number_of_results = ray_count;
+  return true;
+}
+}  // namespace
+
+
 RaysQuery::RaysQuery(RaysQueryDetail *detail)
   : Query(detail)
 {}
@@ -30,12 +276,20 @@ RaysQuery::RaysQuery()
 {}
 
 
-RaysQuery::~RaysQuery() = default;
+RaysQuery::~RaysQuery()
+{
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
+}
 
 
 void RaysQuery::setVolumeCoefficient(double coefficient)
 {
   RaysQueryDetail *d = imp();
+  if (coefficient != d->volume_coefficient)
+  {
+    d->cache.clear();
+  }
   d->volume_coefficient = coefficient;
 }
 
@@ -47,10 +301,40 @@ double RaysQuery::volumeCoefficient() const
 }
 
 
+void RaysQuery::setIncremental(bool incremental)
+{
+  RaysQueryDetail *d = imp();
+  d->incremental = incremental;
+  d->cache.clear();
+}
+
+
+bool RaysQuery::incremental() const
+{
+  const RaysQueryDetail *d = imp();
+  return d->incremental;
+}
+
+
+void RaysQuery::invalidate()
+{
+  RaysQueryDetail *d = imp();
+  d->cache.clear();
+}
+
+
+size_t RaysQuery::evaluatedRayCount() const
+{
+  const RaysQueryDetail *d = imp();
+  return d->evaluated_ray_count;
+}
+
+
 void RaysQuery::setRays(const glm::dvec3 *rays, size_t element_count)
 {
   RaysQueryDetail *d = imp();
   d->rays_in.clear();
+  d->cache.clear();
   addRays(rays, element_count);
 }
 
@@ -67,6 +351,29 @@ void RaysQuery::addRays(const glm::dvec3 *rays, size_t element_count)
 }
 
 
+void RaysQuery::addRays(const glm::vec3 *relative_rays, size_t element_count, const glm::dvec3 &origin)
+{
+  RaysQueryDetail *d = imp();
+  // Ensure we add in pairs.
+  element_count &= ~size_t(1);
+  const size_t offset = d->rays_in.size();
+  d->rays_in.resize(offset + element_count);
+  expandRays(relative_rays, element_count, origin, d->rays_in.data() + offset);
+}
+
+
+void RaysQuery::addRays(const glm::i16vec3 *quantised_rays, size_t element_count, const glm::dvec3 &origin,
+                        double quantisation)
+{
+  RaysQueryDetail *d = imp();
+  // Ensure we add in pairs.
+  element_count &= ~size_t(1);
+  const size_t offset = d->rays_in.size();
+  d->rays_in.resize(offset + element_count);
+  expandRays(quantised_rays, element_count, origin, quantisation, d->rays_in.data() + offset);
+}
+
+
 void RaysQuery::addRay(const glm::dvec3 &origin, const glm::dvec3 &end_point)
 {
   RaysQueryDetail *d = imp();
@@ -78,6 +385,7 @@ void RaysQuery::clearRays()
 {
   RaysQueryDetail *d = imp();
   d->rays_in.clear();
+  d->cache.clear();
 }
 
 
@@ -103,99 +411,12 @@ bool RaysQuery::onExecute()
 {
   RaysQueryDetail *d = imp();
 
-  if (!d->map && !d->valid_layers)
+  if (!d->map || !d->valid_layers)
   {
     return false;
   }
 
-  KeyList keys;
-  MapChunk *last_chunk = nullptr;
-  VoxelBuffer<const VoxelBlock> occupancy_buffer;
-  double unobserved_volume = 0;
-  float range = 0;
-  OccupancyType terminal_state = OccupancyType::kNull;
-  Key terminal_key(nullptr);
-
-  auto *map = d->map;
-  const RayFilterFunction ray_filter = map->rayFilter();
-  const bool use_filter = bool(ray_filter);
-  const auto occupancy_layer = d->occupancy_layer;
-  const auto occupancy_dim = d->occupancy_dim;
-  const auto occupancy_threshold_value = map->occupancyThresholdValue();
-  const auto volume_coefficient = d->volume_coefficient;
-
-  const auto visit_func = [&](const Key &key, double enter_range, double exit_range) -> bool  //
-  {
-    // Work out the index of the voxel in it's region.
-    const unsigned voxel_index = ohm::voxelIndex(key, occupancy_dim);
-    float occupancy_value = unobservedOccupancyValue();
-    // Ensure the MapChunk pointer is up to date.
-    MapChunk *chunk =
-      (last_chunk && key.regionKey() == last_chunk->region.coord) ? last_chunk : map->region(key.regionKey(), false);
-    if (chunk)
-    {
-      if (chunk != last_chunk)
-      {
-        occupancy_buffer = VoxelBuffer<const VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
-      }
-      occupancy_buffer.readVoxel(voxel_index, &occupancy_value);
-    }
-    last_chunk = chunk;
-    // Check voxel occupancy status.
-    const bool is_unobserved = occupancy_value == unobservedOccupancyValue();
-    const bool is_occupied = !is_unobserved && occupancy_value > occupancy_threshold_value;
-    unobserved_volume +=
-      is_unobserved ?
-        (volume_coefficient * (exit_range * exit_range * exit_range - enter_range * enter_range * enter_range)) :
-        0.0f;
-    range = (!is_occupied) ? float(exit_range) : range;
-    // Resolve the voxel state.
-    terminal_state =
-      is_unobserved ? OccupancyType::kUnobserved : (is_occupied ? OccupancyType::kOccupied : OccupancyType::kFree);
-    terminal_key = key;
-
-    return !is_occupied;
-  };
-
-  // Size the output arrays.
-  d->ranges.reserve(d->rays_in.size() / 2);
-  d->intersected_voxels.reserve(d->rays_in.size() / 2);
-  d->unobserved_volumes_out.reserve(d->rays_in.size() / 2);
-  d->terminal_states_out.reserve(d->rays_in.size() / 2);
-
-  glm::dvec3 start;
-  glm::dvec3 end;
-  unsigned filter_flags;
-  for (size_t i = 0; i < d->rays_in.size(); i += 2)
-  {
-    filter_flags = 0;
-    start = d->rays_in[i];
-    end = d->rays_in[i + 1];
-
-    unobserved_volume = 0.0f;
-    range = 0.0f;
-
-    if (use_filter && !ray_filter(&start, &end, &filter_flags))
-    {
-      // Filtered ray.
-      d->ranges.emplace_back(range);
-      d->unobserved_volumes_out.emplace_back(unobserved_volume);
-      d->terminal_states_out.emplace_back(OccupancyType::kNull);
-      d->intersected_voxels.emplace_back(Key::kNull);
-      continue;
-    }
-
-    walkSegmentKeys(LineWalkContext(*map, visit_func), start, end);
-
-    d->ranges.emplace_back(range);
-    d->unobserved_volumes_out.emplace_back(unobserved_volume);
-    d->terminal_states_out.emplace_back(terminal_state);
-    d->intersected_voxels.emplace_back(terminal_key);
-  }
-
-  d->number_of_results = d->ranges.size();
-
-  return true;
+  return raysQueryCpu(*d, useThreads());
 }
 
 
@@ -216,6 +437,7 @@ const OccupancyType *RaysQuery::terminalOccupancyTypes() const
 void RaysQuery::onSetMap()
 {
   RaysQueryDetail *d = imp();
+  d->cache.clear();
   auto map = d->map;
   if (!map)
   {
@@ -232,6 +454,7 @@ void RaysQuery::onSetMap()
   Voxel<const float> occupancy(map, d->occupancy_layer);
 
   d->occupancy_dim = occupancy.isLayerValid() ? occupancy.layerDim() : d->occupancy_dim;
+  d->occupancy_order = occupancy.isLayerValid() ? occupancy.layerVoxelOrder() : d->occupancy_order;
 
   // Validate we only have an occupancy layer.
   d->valid_layers = occupancy.isLayerValid();
@@ -240,7 +463,14 @@ void RaysQuery::onSetMap()
 
 bool RaysQuery::onExecuteAsync()
 {
-  return false;
+  RaysQueryDetail *d = imp();
+
+  if (!d->map || !d->valid_layers)
+  {
+    return false;
+  }
+
+  return executeCpuAsync([this]() { return RaysQuery::onExecute(); });
 }
 
 
@@ -252,6 +482,7 @@ void RaysQuery::onReset(bool hard_reset)
   if (hard_reset)
   {
     d->rays_in.clear();
+    d->cache.clear();
   }
 }
 
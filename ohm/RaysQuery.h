@@ -41,6 +41,15 @@ struct RaysQueryDetail;
 /// Where @c enter_range and @c exit_range are the ranges at which the ray enters and leaves a voxel respectively.
 /// This value is accumulated for each unobserved or null voxel.
 ///
+/// An @c incremental() query retains the results for each ray between executions along with the regions each ray
+/// traverses. Subsequent executions only re-evaluate rays which traverse a region with a changed
+/// @c MapChunk::dirty_stamp , and rays added since the last execution. This suits repeatedly evaluating a static set of
+/// candidate rays, such as in a next best view search, as the map is incrementally updated.
+///
+/// The CPU implementation partitions the rays across TBB workers when built with @c OHM_FEATURE_THREADS and
+/// @c useThreads() is set. @c executeAsync() runs the CPU query on a background thread; the query and the map must not
+/// be modified until @c wait() returns true.
+///
 /// Note: on a hard reset, the set of rays is cleared, while a soft reset leaves the ray set unchanged.
 class ohm_API RaysQuery : public Query
 {
@@ -64,6 +73,21 @@ public:
 
   // --- Parameterisation ---
 
+  /// Enable incremental evaluation, retaining results between executions. See class documentation.
+  ///
+  /// Changing the map, the rays (except by adding rays), or the @c volumeCoefficient() discards the retained results.
+  /// Other changes affecting the results, such as the map @c OccupancyMap::rayFilter() or occupancy threshold, require
+  /// an explicit @c invalidate() . Only CPU evaluation is incremental; GPU evaluation always evaluates every ray.
+  ///
+  /// @param incremental True to enable incremental evaluation.
+  void setIncremental(bool incremental);
+  /// Is incremental evaluation enabled?
+  /// @return True if incremental evaluation is enabled.
+  bool incremental() const;
+
+  /// Discard the results retained for @c incremental() evaluation, so the next execution evaluates all rays.
+  void invalidate();
+
   /// Set the coefficient used in calculating the @c unobservedVolumes() .
   /// See class documentation for detail.
   /// @param coefficient The new coefficient.
@@ -88,6 +112,18 @@ public:
   /// Add rays to the existing set.
   /// @param rays Origin/end point pairs. The size is expected to be even to account for the origin/end pairing.
   void addRays(const std::vector<glm::dvec3> &rays);
+  /// Add single precision rays, relative to @p origin , to the existing set. See @ref compactrays .
+  /// @param relative_rays Origin/end point pairs relative to @p origin .
+  /// @param element_count Number of elements in @p relative_rays . Expected to be even.
+  /// @param origin The origin for @p relative_rays .
+  void addRays(const glm::vec3 *relative_rays, size_t element_count, const glm::dvec3 &origin);
+  /// Add quantised rays, relative to @p origin , to the existing set. See @ref compactrays .
+  /// @param quantised_rays Quantised origin/end point pairs relative to @p origin .
+  /// @param element_count Number of elements in @p quantised_rays . Expected to be even.
+  /// @param origin The origin for @p quantised_rays .
+  /// @param quantisation The quantisation step for @p quantised_rays .
+  void addRays(const glm::i16vec3 *quantised_rays, size_t element_count, const glm::dvec3 &origin,
+               double quantisation);
   /// Add a single ray to the existing set.
   /// @param origin The ray origin.
   /// @param end_point The ray end_point.
@@ -101,6 +137,10 @@ public:
   /// Query the number of query rays.
   size_t numberOfRays() const;
 
+  /// Query the number of rays walked by the last execution. This is @c numberOfRays() unless @c incremental() .
+  /// @return The number of rays evaluated.
+  size_t evaluatedRayCount() const;
+
   // --- Results ---
 
   /// An approximation of the volume of previously unobserved space each ray traverses. The number of elements matches
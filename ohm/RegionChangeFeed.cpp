@@ -0,0 +1,117 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RegionChangeFeed.h"
+
+#include "OccupancyMap.h"
+
+#include "private/OccupancyMapDetail.h"
+#include "private/RegionChangeFeedDetail.h"
+
+#include <algorithm>
+
+namespace ohm
+{
+void RegionChangeFeedDetail::rebase(const glm::dvec3 &region_shift)
+{
+  std::function<void(const glm::dvec3 &)> callback;
+  {
+    std::unique_lock<Mutex> guard(mutex);
+    pending_set.clear();
+    auto keep_iter = pending.begin();
+    for (glm::i16vec3 region_key : pending)
+    {
+      if (OccupancyMap::shiftRegionKey(region_key, region_shift))
+      {
+        pending_set.insert(region_key);
+        *keep_iter++ = region_key;
+      }
+    }
+    pending.erase(keep_iter, pending.end());
+    ++rebase_count;
+    callback = rebase_callback;
+  }
+
+  // Invoke without the lock so the callback may drain the feed.
+  if (callback)
+  {
+    callback(region_shift);
+  }
+}
+
+
+RegionChangeFeed::RegionChangeFeed(OccupancyMap &map)
+  : imp_(std::make_unique<RegionChangeFeedDetail>())
+{
+  OccupancyMapDetail *map_detail = map.detail();
+  std::unique_lock<Mutex> guard(map_detail->change_feed_mutex);
+  imp_->map = map_detail;
+  map_detail->change_feeds.emplace_back(imp_.get());
+  map_detail->change_feed_count = unsigned(map_detail->change_feeds.size());
+}
+
+
+RegionChangeFeed::~RegionChangeFeed()
+{
+  OccupancyMapDetail *map_detail = imp_->map;
+  if (map_detail)
+  {
+    std::unique_lock<Mutex> guard(map_detail->change_feed_mutex);
+    auto &feeds = map_detail->change_feeds;
+    feeds.erase(std::remove(feeds.begin(), feeds.end(), imp_.get()), feeds.end());
+    map_detail->change_feed_count = unsigned(feeds.size());
+  }
+}
+
+
+bool RegionChangeFeed::isSubscribed() const
+{
+  return imp_->map != nullptr;
+}
+
+
+size_t RegionChangeFeed::pendingCount() const
+{
+  std::unique_lock<Mutex> guard(imp_->mutex);
+  return imp_->pending.size();
+}
+
+
+size_t RegionChangeFeed::drain(std::vector<glm::i16vec3> &regions)
+{
+  std::vector<glm::i16vec3> drained;
+  {
+    // Swap out the queue so notification is only blocked for the swap.
+    std::unique_lock<Mutex> guard(imp_->mutex);
+    drained.swap(imp_->pending);
+    imp_->pending_set.clear();
+  }
+
+  regions.insert(regions.end(), drained.begin(), drained.end());
+  return drained.size();
+}
+
+
+void RegionChangeFeed::clear()
+{
+  std::unique_lock<Mutex> guard(imp_->mutex);
+  imp_->pending.clear();
+  imp_->pending_set.clear();
+}
+
+
+unsigned RegionChangeFeed::rebaseCount() const
+{
+  std::unique_lock<Mutex> guard(imp_->mutex);
+  return imp_->rebase_count;
+}
+
+
+void RegionChangeFeed::setRebaseCallback(const std::function<void(const glm::dvec3 &)> &callback)
+{
+  std::unique_lock<Mutex> guard(imp_->mutex);
+  imp_->rebase_callback = callback;
+}
+}  // namespace ohm
@@ -0,0 +1,102 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONCHANGEFEED_H
+#define OHM_REGIONCHANGEFEED_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct RegionChangeFeedDetail;
+
+/// An event driven feed of the regions changed in an @c OccupancyMap .
+///
+/// The feed subscribes to the map on construction and unsubscribes on destruction. The map then notifies the feed
+/// whenever the @c MapChunk::dirty_stamp of a region advances - see @c MapChunk::markDirty() - and the feed queues
+/// the region key. A consumer calls @c drain() to collect the regions changed since the last drain, which costs
+/// O(changes) rather than the O(regions) scan of @c OccupancyMap::collectDirtyRegions() .
+///
+/// Batched updates, such as those of a @c RayMapperOccupancy , notify once per region per update. Each queued region
+/// is reported once per drain regardless of how often it changes between drains. Regions are reported in order of
+/// their first change since the last drain.
+///
+/// Notification is thread safe and @c drain() may be called concurrently with map updates. A region changed during
+/// a drain is either included in that drain or reported by the next one. A drained region may since have been
+/// removed from the map, so consumers must handle failed region lookups. Removing regions does not notify the feed.
+///
+/// @c OccupancyMap::rebaseOrigin() publishes a rebase event to the feed. The queued region keys are shifted to the
+/// new origin, dropping those which leave the key range, then the rebase callback is invoked - see
+/// @c setRebaseCallback() . The re-keyed regions are then queued as changed.
+///
+/// The feed may outlive the map, in which case it is detached and reports no further changes, but the map must not
+/// be destroyed concurrently with the destruction of a feed.
+///
+/// @code
+/// ohm::RegionChangeFeed feed(map);
+/// std::vector<glm::i16vec3> changed;
+/// while (running)
+/// {
+///   integrate(map);
+///   feed.drain(changed);
+///   publish(map, changed);
+///   changed.clear();
+/// }
+/// @endcode
+class ohm_API RegionChangeFeed
+{
+public:
+  /// Create a feed subscribed to @p map .
+  /// @param map The map to subscribe to.
+  explicit RegionChangeFeed(OccupancyMap &map);
+  /// Non-copyable.
+  RegionChangeFeed(const RegionChangeFeed &other) = delete;
+  /// Destructor: unsubscribes from the map.
+  ~RegionChangeFeed();
+
+  /// Non-copyable.
+  RegionChangeFeed &operator=(const RegionChangeFeed &other) = delete;
+
+  /// Is the feed still subscribed to a map? This is false once the map has been destroyed.
+  /// @return True when subscribed.
+  bool isSubscribed() const;
+
+  /// Query the number of regions queued for the next @c drain() .
+  /// @return The number of queued regions.
+  size_t pendingCount() const;
+
+  /// Collect the regions changed since the last drain, clearing the queue.
+  /// @param[out] regions The changed region keys are appended here. Not cleared.
+  /// @return The number of region keys added to @p regions .
+  size_t drain(std::vector<glm::i16vec3> &regions);
+
+  /// Clear the queue without collecting the regions.
+  void clear();
+
+  /// Query the number of @c OccupancyMap::rebaseOrigin() events received.
+  /// @return The rebase count.
+  unsigned rebaseCount() const;
+
+  /// Set a function to invoke on each @c OccupancyMap::rebaseOrigin() . Consumers which cache region keys use this to
+  /// re-key their data - see @c OccupancyMap::shiftRegionKey() .
+  ///
+  /// The callback is invoked on the thread calling @c OccupancyMap::rebaseOrigin() , after the queued keys have
+  /// been shifted. It may @c drain() this feed, but must not create or destroy feeds for the same map.
+  /// @param callback The function to invoke with the region key shift. May be empty to clear the callback.
+  void setRebaseCallback(const std::function<void(const glm::dvec3 &)> &callback);
+
+private:
+  std::unique_ptr<RegionChangeFeedDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONCHANGEFEED_H
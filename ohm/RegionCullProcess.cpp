@@ -0,0 +1,287 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RegionCullProcess.h"
+
+#include "Aabb.h"
+#include "MapChunk.h"
+#include "MapProbability.h"
+#include "OccupancyMap.h"
+#include "OccupancyTransform.h"
+
+#include "private/OccupancyMapDetail.h"
+#include "private/RegionCullProcessDetail.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace ohm
+{
+namespace
+{
+/// Number of regions to check between time slice checks.
+const size_t kTimeCheckInterval = 64u;
+}  // namespace
+
+
+RegionCullProcess::RegionCullProcess()
+  : imp_(new RegionCullProcessDetail)
+{}
+
+
+RegionCullProcess::~RegionCullProcess()
+{
+  RegionCullProcessDetail *d = imp();
+  OccupancyMap::releaseRegions(d->detached);
+  delete d;
+  imp_ = nullptr;
+}
+
+
+void RegionCullProcess::setExpiryTime(double timestamp)
+{
+  imp()->expiry_time = timestamp;
+  imp()->expiry_enabled = true;
+}
+
+
+void RegionCullProcess::clearExpiryTime()
+{
+  imp()->expiry_enabled = false;
+}
+
+
+double RegionCullProcess::expiryTime() const
+{
+  return imp()->expiry_time;
+}
+
+
+bool RegionCullProcess::expiryEnabled() const
+{
+  return imp()->expiry_enabled;
+}
+
+
+void RegionCullProcess::setDecayCullTime(double timestamp)
+{
+  imp()->decay_time = timestamp;
+  imp()->decay_enabled = true;
+}
+
+
+void RegionCullProcess::clearDecayCullTime()
+{
+  imp()->decay_enabled = false;
+}
+
+
+double RegionCullProcess::decayCullTime() const
+{
+  return imp()->decay_time;
+}
+
+
+bool RegionCullProcess::decayCullEnabled() const
+{
+  return imp()->decay_enabled;
+}
+
+
+void RegionCullProcess::setDecayCullProbability(float probability)
+{
+  imp()->decay_probability = probability;
+}
+
+
+float RegionCullProcess::decayCullProbability() const
+{
+  return imp()->decay_probability;
+}
+
+
+void RegionCullProcess::setCullDistance(double distance)
+{
+  imp()->cull_distance = std::max(distance, 0.0);
+}
+
+
+double RegionCullProcess::cullDistance() const
+{
+  return imp()->cull_distance;
+}
+
+
+void RegionCullProcess::setCullExtents(const glm::dvec3 &min_extents, const glm::dvec3 &max_extents)
+{
+  RegionCullProcessDetail *d = imp();
+  d->cull_min_extents = min_extents;
+  d->cull_max_extents = max_extents;
+  d->extents_enabled = true;
+}
+
+
+void RegionCullProcess::clearCullExtents()
+{
+  imp()->extents_enabled = false;
+}
+
+
+bool RegionCullProcess::cullExtents(glm::dvec3 *min_extents, glm::dvec3 *max_extents) const
+{
+  const RegionCullProcessDetail *d = imp();
+  if (!d->extents_enabled)
+  {
+    return false;
+  }
+
+  if (min_extents)
+  {
+    *min_extents = d->cull_min_extents;
+  }
+  if (max_extents)
+  {
+    *max_extents = d->cull_max_extents;
+  }
+  return true;
+}
+
+
+size_t RegionCullProcess::pendingReleaseCount() const
+{
+  return imp()->detached.size();
+}
+
+
+size_t RegionCullProcess::removedCount() const
+{
+  return imp()->removed_count;
+}
+
+
+void RegionCullProcess::flush()
+{
+  OccupancyMap::releaseRegions(imp()->detached);
+}
+
+
+void RegionCullProcess::reset()
+{
+  RegionCullProcessDetail *d = imp();
+  d->sweep_keys.clear();
+  d->sweep_index = 0;
+  d->marked_keys.clear();
+  flush();
+}
+
+
+int RegionCullProcess::update(OccupancyMap &map, double time_slice)
+{
+  using Clock = std::chrono::high_resolution_clock;
+  const auto start_time = Clock::now();
+  const auto time_expired = [start_time, time_slice]() {
+    if (time_slice <= 0)
+    {
+      return false;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time);
+    return elapsed.count() >= time_slice;
+  };
+
+  RegionCullProcessDetail *d = imp();
+
+  // Regions removed by the previous update have had an update period to fall out of use.
+  OccupancyMap::releaseRegions(d->detached);
+
+  const bool cull_distance = d->cull_distance > 0 && hasReferencePosition();
+  const bool cull_decayed = d->decay_enabled && map.occupancyDecayTime() > 0;
+  if (!d->expiry_enabled && !cull_distance && !d->extents_enabled && !cull_decayed)
+  {
+    d->sweep_keys.clear();
+    d->sweep_index = 0;
+    return kMprUpToDate;
+  }
+
+  const ChunkMap &chunks = map.detail()->chunks;
+  if (d->sweep_index >= d->sweep_keys.size())
+  {
+    // Start a new sweep from a snapshot of the current regions.
+    d->sweep_keys.clear();
+    d->sweep_keys.reserve(chunks.size());
+    for (auto &&chunk_ref : chunks)
+    {
+      d->sweep_keys.emplace_back(chunk_ref.first);
+    }
+    d->sweep_index = 0;
+  }
+
+  const glm::dvec3 region_extents = map.regionSpatialResolution();
+  const Aabb cull_box(d->cull_min_extents, d->cull_max_extents);
+  const double cull_distance_sqr = d->cull_distance * d->cull_distance;
+  const float decay_epsilon = std::abs(probabilityToValue(d->decay_probability));
+  const auto should_cull = [&](const MapChunk &chunk) {
+    if (d->expiry_enabled && chunk.touched_time < d->expiry_time)
+    {
+      return true;
+    }
+
+    if (cull_distance)
+    {
+      const glm::dvec3 separation = chunk.region.centre - referencePosition();
+      if (glm::dot(separation, separation) >= cull_distance_sqr)
+      {
+        return true;
+      }
+    }
+
+    if (d->extents_enabled &&
+        !cull_box.overlaps(
+          Aabb(chunk.region.centre - 0.5 * region_extents, chunk.region.centre + 0.5 * region_extents)))
+    {
+      return true;
+    }
+
+    // Checked last as it reads the voxels.
+    return cull_decayed && isRegionDecayed(map, chunk, d->decay_time, decay_epsilon);
+  };
+
+  // Mark regions for removal. Regions removed since the snapshot are skipped.
+  d->marked_keys.clear();
+  while (d->sweep_index < d->sweep_keys.size())
+  {
+    const glm::i16vec3 &region_key = d->sweep_keys[d->sweep_index++];
+    const MapChunk *chunk = chunks.lookup(region_key);
+    if (chunk && should_cull(*chunk))
+    {
+      d->marked_keys.emplace_back(region_key);
+    }
+
+    if (d->sweep_index % kTimeCheckInterval == 0 && time_expired())
+    {
+      break;
+    }
+  }
+
+  d->removed_count += map.detachRegions(d->marked_keys, d->detached);
+  d->marked_keys.clear();
+
+  return (d->sweep_index >= d->sweep_keys.size() && d->detached.empty()) ? kMprUpToDate : kMprProgressing;
+}
+
+
+RegionCullProcessDetail *RegionCullProcess::imp()
+{
+  return imp_;
+}
+
+
+const RegionCullProcessDetail *RegionCullProcess::imp() const
+{
+  return imp_;
+}
+}  // namespace ohm
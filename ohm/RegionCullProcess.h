@@ -0,0 +1,152 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONCULLPROCESS_H
+#define OHM_REGIONCULLPROCESS_H
+
+#include "OhmConfig.h"
+
+#include "MappingProcess.h"
+
+#include <glm/fwd.hpp>
+
+#include <cstddef>
+
+namespace ohm
+{
+struct RegionCullProcessDetail;
+
+/// A mapping process which expires and culls map regions incrementally, off the ray integration path.
+///
+/// This is an alternative to calling @c OccupancyMap::expireRegions() , @c OccupancyMap::removeDistanceRegions() or
+/// @c OccupancyMap::cullRegionsOutside() directly, each of which walks and deletes all affected regions in one call.
+/// Instead each @c update() :
+/// - Releases the regions removed by the previous @c update() (deferred deletion).
+/// - Continues a sweep of the map regions, marking those which meet any of the cull criteria, until the time slice
+///   expires. A new sweep starts from a snapshot of the region keys once the previous sweep completes.
+/// - Removes the marked regions from the map. Removal is constant time per region and does not block concurrent
+///   region lookups - see @c OccupancyMap::detachRegions() .
+///
+/// Removed region memory is retained until the next @c update() so that concurrent readers which resolved a region
+/// before removal do not reference released memory. Call @c flush() to release immediately once no other thread is
+/// accessing the map.
+///
+/// The cull criteria are:
+/// - Expiry: regions with a @c MapChunk::touched_time before the @c expiryTime() . See @c setExpiryTime() .
+/// - Distance: regions with centres further than @c cullDistance() from the @c referencePosition() .
+/// - Extents: regions which do not overlap the @c setCullExtents() box.
+/// - Decay: regions where every observed voxel has decayed to near the uncertain prior by the @c decayCullTime() .
+///   Requires lazy occupancy decay - see @c OccupancyMap::setOccupancyDecayTime() and @c isRegionDecayed() . This
+///   criterion reads the voxels of each region, but stops at the first voxel which has not decayed.
+///
+/// A region is removed if it meets any enabled criterion. All criteria are disabled by default.
+class ohm_API RegionCullProcess : public MappingProcess
+{
+public:
+  /// Constructor. No cull criteria are enabled.
+  RegionCullProcess();
+
+  /// Destructor. Releases any regions pending deletion.
+  ~RegionCullProcess() override;
+
+  /// Set the expiry time. Regions last touched before @p timestamp are removed. Generally updated with the latest
+  /// sensor time less the desired region lifetime.
+  /// @param timestamp The expiry timestamp.
+  void setExpiryTime(double timestamp);
+
+  /// Disable region expiry.
+  void clearExpiryTime();
+
+  /// Query the region expiry time. Only valid when @c expiryEnabled() .
+  /// @return The expiry timestamp.
+  double expiryTime() const;
+
+  /// Query if region expiry is enabled.
+  /// @return True if expiry is enabled.
+  bool expiryEnabled() const;
+
+  /// Enable culling of fully decayed regions, evaluating the decay at @p timestamp . Generally updated with the latest
+  /// sensor time.
+  /// @param timestamp The time to evaluate voxel decay at.
+  void setDecayCullTime(double timestamp);
+
+  /// Disable culling of decayed regions.
+  void clearDecayCullTime();
+
+  /// Query the time the decay criterion is evaluated at. Only valid when @c decayCullEnabled() .
+  /// @return The decay cull timestamp.
+  double decayCullTime() const;
+
+  /// Query if culling of decayed regions is enabled.
+  /// @return True if decay culling is enabled.
+  bool decayCullEnabled() const;
+
+  /// Set the occupancy probability within which a voxel is considered fully decayed. A voxel has decayed when its
+  /// probability is within the range [1 - @p probability , @p probability ].
+  /// @param probability The decayed probability limit (0.5, 1). Defaults to 0.52.
+  void setDecayCullProbability(float probability);
+
+  /// Query the decayed probability limit. See @c setDecayCullProbability() .
+  /// @return The decayed probability limit.
+  float decayCullProbability() const;
+
+  /// Set the distance from the @c referencePosition() beyond which regions are removed. Ignored when no reference
+  /// position is set.
+  /// @param distance The cull distance. Zero or negative to disable.
+  void setCullDistance(double distance);
+
+  /// Query the cull distance. Zero when disabled.
+  /// @return The cull distance.
+  double cullDistance() const;
+
+  /// Set an axis aligned box outside of which regions are removed.
+  /// @param min_extents The box minimum extents.
+  /// @param max_extents The box maximum extents.
+  void setCullExtents(const glm::dvec3 &min_extents, const glm::dvec3 &max_extents);
+
+  /// Disable culling by extents.
+  void clearCullExtents();
+
+  /// Query the cull extents.
+  /// @param[out] min_extents Set to the box minimum extents when enabled.
+  /// @param[out] max_extents Set to the box maximum extents when enabled.
+  /// @return True if culling by extents is enabled.
+  bool cullExtents(glm::dvec3 *min_extents, glm::dvec3 *max_extents) const;
+
+  /// Query the number of regions awaiting deferred deletion.
+  /// @return The number of removed regions which are yet to be released.
+  size_t pendingReleaseCount() const;
+
+  /// Query the total number of regions removed by this process.
+  /// @return The total removed regions.
+  size_t removedCount() const;
+
+  /// Release regions pending deferred deletion. Only safe once no other thread may reference removed regions.
+  void flush();
+
+  /// Abandon the current sweep and release regions pending deletion. Cull criteria are unchanged.
+  void reset() override;
+
+  /// Continue the current sweep, removing regions meeting the cull criteria.
+  ///
+  /// @param map The map to cull.
+  /// @param time_slice The amount of time available for processing (seconds). Zero or negative for no limit.
+  /// @return @c kMprUpToDate once a sweep completes without leaving regions to release, @c kMprProgressing otherwise.
+  int update(OccupancyMap &map, double time_slice) override;
+
+protected:
+  /// Internal data access
+  /// @return The internal data members.
+  RegionCullProcessDetail *imp();
+  /// Internal data access
+  /// @return The internal data members.
+  const RegionCullProcessDetail *imp() const;
+
+private:
+  RegionCullProcessDetail *imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONCULLPROCESS_H
@@ -0,0 +1,154 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONINDEXER_H
+#define OHM_REGIONINDEXER_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+
+#include <glm/vec3.hpp>
+
+namespace ohm
+{
+/// Precomputed arithmetic for addressing voxels in map regions of fixed voxel dimensions.
+///
+/// Converting a row major voxel index into a local key, or wrapping a key across region boundaries, requires division
+/// and modulo by the region dimensions. When every dimension is a power of two - as for the default
+/// @c OHM_DEFAULT_CHUNK_DIM_X etc. - these reduce to shifts and masks. The indexer selects the shift and mask
+/// arithmetic on construction when the dimensions allow, falling back to general arithmetic otherwise. Both paths give
+/// identical results.
+///
+/// Each @c OccupancyMap creates an indexer for its region dimensions - see @c OccupancyMap::regionIndexer() .
+class RegionIndexer
+{
+public:
+  /// Default constructor: zero dimensions. Not usable for indexing.
+  RegionIndexer() = default;
+
+  /// Create an indexer for regions of @p dim voxels.
+  /// @param dim The region voxel dimensions. Each must be in the range [1, 255].
+  explicit inline RegionIndexer(const glm::ivec3 &dim)
+    : dim_(dim)
+  {
+    pow2_ = true;
+    for (int i = 0; i < 3; ++i)
+    {
+      shift_[i] = log2Exact(dim[i]);
+      pow2_ = pow2_ && shift_[i] >= 0;
+    }
+    mask_ = dim_ - glm::ivec3(1);
+    if (!pow2_)
+    {
+      shift_ = glm::ivec3(0);
+    }
+  }
+
+  /// Query the region voxel dimensions.
+  /// @return The region dimensions.
+  inline const glm::ivec3 &dimensions() const { return dim_; }
+
+  /// Check if the shift and mask arithmetic is in use. True when all dimensions are powers of two.
+  /// @return True for power of two dimensions.
+  inline bool isPowerOfTwo() const { return pow2_; }
+
+  /// Convert a local key into a row major voxel index. Equivalent to @c voxelIndex(const glm::u8vec3 &,
+  /// const glm::ivec3 &) .
+  /// @param local_key The local voxel key.
+  /// @return The row major voxel index.
+  inline unsigned index(const glm::u8vec3 &local_key) const
+  {
+    if (pow2_)
+    {
+      return unsigned(local_key.x) | (unsigned(local_key.y) << unsigned(shift_.x)) |
+             (unsigned(local_key.z) << unsigned(shift_.x + shift_.y));
+    }
+    return unsigned(local_key.x) + unsigned(local_key.y) * dim_.x + unsigned(local_key.z) * dim_.x * dim_.y;
+  }
+
+  /// Convert a row major voxel index into a local key. Equivalent to @c voxelLocalKey(unsigned, const glm::ivec3 &) .
+  /// @param index The row major voxel index.
+  /// @return The local voxel key.
+  inline glm::u8vec3 localKey(unsigned index) const
+  {
+    if (pow2_)
+    {
+      return glm::u8vec3(index & unsigned(mask_.x), (index >> unsigned(shift_.x)) & unsigned(mask_.y),
+                         index >> unsigned(shift_.x + shift_.y));
+    }
+    const unsigned plane = unsigned(dim_.x * dim_.y);
+    return glm::u8vec3(index % unsigned(dim_.x), (index % plane) / unsigned(dim_.x), index / plane);
+  }
+
+  /// Convert a row major voxel index into a @c Key .
+  /// @param index The row major voxel index.
+  /// @param region_coord The region containing the voxel.
+  /// @return The voxel key.
+  inline Key key(unsigned index, const glm::i16vec3 &region_coord) const { return Key(region_coord, localKey(index)); }
+
+  /// Move a @p key @p step voxels along an @p axis , stepping into adjacent regions as required. Equivalent to
+  /// @c OccupancyMap::moveKeyAlongAxis() .
+  /// @param key The key to adjust.
+  /// @param axis Axis ID to move along [0, 2].
+  /// @param step How far to move/step.
+  inline void moveKeyAlongAxis(Key &key, int axis, int step) const
+  {
+    int local = int(key.localKey()[axis]) + step;
+    if (local >= 0 && local < dim_[axis])
+    {
+      // Remain in the same region.
+      key.setLocalAxis(axis, uint8_t(local));
+      return;
+    }
+
+    int region_step = 0;
+    if (pow2_)
+    {
+      // Arithmetic shift floors negative values, while the mask yields the positive modulus.
+      region_step = local >> shift_[axis];
+      local &= mask_[axis];
+    }
+    else
+    {
+      region_step = local / dim_[axis];
+      local %= dim_[axis];
+      if (local < 0)
+      {
+        local += dim_[axis];
+        --region_step;
+      }
+    }
+
+    key.setRegionAxis(axis, int16_t(key.regionKey()[axis] + region_step));
+    key.setLocalAxis(axis, uint8_t(local));
+  }
+
+  /// Calculate the base 2 logarithm of @p value if it is a power of two.
+  /// @param value The value to test.
+  /// @return The base 2 logarithm or -1 if @p value is not a positive power of two.
+  static inline int log2Exact(int value)
+  {
+    if (value <= 0 || (value & (value - 1)) != 0)
+    {
+      return -1;
+    }
+    int shift = 0;
+    while ((1 << shift) != value)
+    {
+      ++shift;
+    }
+    return shift;
+  }
+
+private:
+  glm::ivec3 dim_{ 0 };
+  glm::ivec3 shift_{ 0 };
+  glm::ivec3 mask_{ 0 };
+  bool pow2_ = false;
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONINDEXER_H
@@ -0,0 +1,131 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RegionPreallocator.h"
+
+#include "OccupancyMap.h"
+
+#include "private/RegionPreallocatorDetail.h"
+
+namespace ohm
+{
+namespace
+{
+void workerThread(RegionPreallocatorDetail &imp)
+{
+  std::unique_lock<std::mutex> guard(imp.queue_lock);
+  while (true)
+  {
+    imp.queue_notify.wait(guard, [&imp]() { return !imp.queue.empty() || imp.quit_flag; });
+    if (imp.quit_flag)
+    {
+      break;
+    }
+
+    const RegionPreallocateRequest request = std::move(imp.queue.front());
+    imp.queue.pop_front();
+    imp.busy = true;
+    // Preallocate without holding the lock so new requests may be queued.
+    guard.unlock();
+    const size_t count = (request.path.empty()) ? imp.map->preallocateRegions(request.extents) :
+                                                  imp.map->preallocateAlongPath(request.path, request.radius);
+    imp.preallocated_count += count;
+    guard.lock();
+    imp.busy = false;
+    if (imp.queue.empty())
+    {
+      imp.idle_notify.notify_all();
+    }
+  }
+
+  imp.busy = false;
+  imp.idle_notify.notify_all();
+}
+}  // namespace
+
+
+RegionPreallocator::RegionPreallocator(OccupancyMap &map)
+  : imp_(std::make_unique<RegionPreallocatorDetail>())
+{
+  imp_->map = &map;
+  RegionPreallocatorDetail *imp = imp_.get();
+  imp_->worker_thread = std::thread([imp]() { workerThread(*imp); });
+}
+
+
+RegionPreallocator::~RegionPreallocator()
+{
+  {
+    std::unique_lock<std::mutex> guard(imp_->queue_lock);
+    imp_->queue.clear();
+    imp_->quit_flag = true;
+  }
+  imp_->queue_notify.notify_one();
+  imp_->worker_thread.join();
+}
+
+
+OccupancyMap &RegionPreallocator::map() const
+{
+  return *imp_->map;
+}
+
+
+void RegionPreallocator::preallocate(const Aabb &extents)
+{
+  RegionPreallocateRequest request;
+  request.extents = extents;
+  std::unique_lock<std::mutex> guard(imp_->queue_lock);
+  imp_->queue.emplace_back(std::move(request));
+  imp_->queue_notify.notify_one();
+}
+
+
+void RegionPreallocator::preallocateAlongPath(const std::vector<glm::dvec3> &path, double radius)
+{
+  if (path.empty())
+  {
+    return;
+  }
+
+  RegionPreallocateRequest request;
+  request.path = path;
+  request.radius = radius;
+  std::unique_lock<std::mutex> guard(imp_->queue_lock);
+  imp_->queue.emplace_back(std::move(request));
+  imp_->queue_notify.notify_one();
+}
+
+
+void RegionPreallocator::cancel()
+{
+  std::unique_lock<std::mutex> guard(imp_->queue_lock);
+  imp_->queue.clear();
+  if (!imp_->busy)
+  {
+    imp_->idle_notify.notify_all();
+  }
+}
+
+
+void RegionPreallocator::wait()
+{
+  std::unique_lock<std::mutex> guard(imp_->queue_lock);
+  imp_->idle_notify.wait(guard, [this]() { return (imp_->queue.empty() && !imp_->busy) || imp_->quit_flag; });
+}
+
+
+size_t RegionPreallocator::pendingCount() const
+{
+  std::unique_lock<std::mutex> guard(imp_->queue_lock);
+  return imp_->queue.size() + (imp_->busy ? 1u : 0u);
+}
+
+
+size_t RegionPreallocator::preallocatedCount() const
+{
+  return imp_->preallocated_count;
+}
+}  // namespace ohm
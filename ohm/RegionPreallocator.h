@@ -0,0 +1,80 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONPREALLOCATOR_H
+#define OHM_REGIONPREALLOCATOR_H
+
+#include "OhmConfig.h"
+
+#include <glm/fwd.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+class Aabb;
+class OccupancyMap;
+struct RegionPreallocatorDetail;
+
+/// Creates and initialises map regions on a background thread ahead of ray integration.
+///
+/// Creating a region allocates and initialises the voxel memory for every layer. When this occurs lazily within the
+/// ray integration - see @c OccupancyMap::region() - it shows up as a latency spike each time the sensor enters
+/// unmapped space. A @c RegionPreallocator is given the space the sensor is expected to observe, such as the planned
+/// trajectory, and creates the regions in advance using @c OccupancyMap::preallocateRegions() and
+/// @c OccupancyMap::preallocateAlongPath() , so the chunks already exist by the time the rays arrive.
+///
+/// Requests are queued and processed in order on a single background thread. Region creation is thread safe with
+/// respect to concurrent @c OccupancyMap::region() calls, so ray integration may continue while the preallocation
+/// proceeds. However, operations which are not thread safe with respect to @c OccupancyMap::region() - such as
+/// @c OccupancyMap::clear() - must not be made until @c wait() returns or the preallocator is destroyed.
+class ohm_API RegionPreallocator
+{
+public:
+  /// Create a preallocator for @p map , starting the background thread.
+  /// @param map The map to preallocate regions in. Must outlive this object.
+  explicit RegionPreallocator(OccupancyMap &map);
+
+  /// Destructor. Cancels pending requests and waits for the current request to complete.
+  ~RegionPreallocator();
+
+  RegionPreallocator(const RegionPreallocator &) = delete;
+  RegionPreallocator &operator=(const RegionPreallocator &) = delete;
+
+  /// Access the target map.
+  /// @return The map regions are preallocated in.
+  OccupancyMap &map() const;
+
+  /// Queue preallocation of all regions overlapping @p extents . See @c OccupancyMap::preallocateRegions() .
+  /// @param extents The box to preallocate regions for (global coordinates).
+  void preallocate(const Aabb &extents);
+
+  /// Queue preallocation of all regions within @p radius of @p path . See @c OccupancyMap::preallocateAlongPath() .
+  /// @param path The planned path points (global coordinates).
+  /// @param radius The distance from the path to preallocate regions for. Generally the sensor range.
+  void preallocateAlongPath(const std::vector<glm::dvec3> &path, double radius);
+
+  /// Drop all queued requests which have not yet started.
+  void cancel();
+
+  /// Block until all queued requests have been processed.
+  void wait();
+
+  /// Query the number of queued requests, including any request in progress.
+  /// @return The number of incomplete requests.
+  size_t pendingCount() const;
+
+  /// Query the total number of regions created, or paged in, by this object.
+  /// @return The number of regions preallocated.
+  size_t preallocatedCount() const;
+
+private:
+  std::unique_ptr<RegionPreallocatorDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONPREALLOCATOR_H
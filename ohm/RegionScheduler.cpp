@@ -0,0 +1,124 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RegionScheduler.h"
+
+#include "MapChunk.h"
+#include "OccupancyMap.h"
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <vector>
+
+namespace ohm
+{
+RegionScheduler::RegionScheduler() = default;
+
+
+RegionScheduler::~RegionScheduler() = default;
+
+
+void RegionScheduler::setReferencePosition(const glm::dvec3 &position)
+{
+  reference_position_ = position;
+  has_reference_position_ = true;
+}
+
+
+void RegionScheduler::clearReferencePosition()
+{
+  has_reference_position_ = false;
+}
+
+
+bool RegionScheduler::push(const glm::i16vec3 &region_key)
+{
+  return queue_.emplace(region_key, Clock::now()).second;
+}
+
+
+unsigned RegionScheduler::pushDirtyRegions(const OccupancyMap &map, int source_layer, int target_layer,
+                                           int region_padding)
+{
+  if (source_layer < 0 || target_layer < 0)
+  {
+    return 0;
+  }
+
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+
+  unsigned added = 0;
+  for (const MapChunk *chunk : chunks)
+  {
+    if (chunk->touched_stamps[target_layer] >= chunk->touched_stamps[source_layer])
+    {
+      continue;
+    }
+
+    const glm::ivec3 region_key = chunk->region.coord;
+    for (int z = -region_padding; z <= region_padding; ++z)
+    {
+      for (int y = -region_padding; y <= region_padding; ++y)
+      {
+        for (int x = -region_padding; x <= region_padding; ++x)
+        {
+          added += (push(glm::i16vec3(region_key + glm::ivec3(x, y, z)))) ? 1 : 0;
+        }
+      }
+    }
+  }
+
+  return added;
+}
+
+
+bool RegionScheduler::pop(const OccupancyMap &map, glm::i16vec3 *region_key)
+{
+  if (queue_.empty())
+  {
+    return false;
+  }
+
+  const Clock::time_point now = Clock::now();
+  auto best = queue_.end();
+  bool best_in_priority_radius = false;
+  double best_cost = std::numeric_limits<double>::max();
+
+  for (auto iter = queue_.begin(); iter != queue_.end(); ++iter)
+  {
+    const double distance =
+      (has_reference_position_) ? glm::length(map.regionSpatialCentre(iter->first) - reference_position_) : 0.0;
+    const bool in_priority_radius = has_reference_position_ && priority_radius_ > 0 && distance <= priority_radius_;
+
+    double cost = distance;
+    if (!in_priority_radius)
+    {
+      const double waiting = std::chrono::duration_cast<std::chrono::duration<double>>(now - iter->second).count();
+      cost -= staleness_weight_ * waiting;
+    }
+
+    // Regions in the priority radius always take precedence.
+    if ((in_priority_radius && !best_in_priority_radius) ||
+        (in_priority_radius == best_in_priority_radius && cost < best_cost))
+    {
+      best = iter;
+      best_cost = cost;
+      best_in_priority_radius = in_priority_radius;
+    }
+  }
+
+  *region_key = best->first;
+  queue_.erase(best);
+  return true;
+}
+
+
+void RegionScheduler::clear()
+{
+  queue_.clear();
+}
+}  // namespace ohm
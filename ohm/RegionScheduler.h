@@ -0,0 +1,120 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONSCHEDULER_H
+#define OHM_REGIONSCHEDULER_H
+
+#include "OhmConfig.h"
+
+#include "MapRegion.h"
+
+#include <glm/vec3.hpp>
+
+#include <chrono>
+#include <unordered_map>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// A priority queue of regions awaiting update by a @c MappingProcess .
+///
+/// Regions are popped in order of priority, where the priority is determined by the distance from the region centre
+/// to the @c referencePosition() - generally the robot position - and by how long the region has been waiting in the
+/// queue. The result is that regions close to the reference position are updated first, while far away regions are
+/// not starved indefinitely.
+///
+/// Priority is ordered as follows:
+/// - Regions within the @c priorityRadius() of the reference position are always popped first, nearest first.
+/// - Other regions are ordered by the lowest cost, where the cost is the distance to the reference position (metres)
+///   less the time spent in the queue (seconds) multiplied by the @c stalenessWeight() .
+///
+/// Without a reference position, all regions are considered equidistant and are popped oldest first.
+///
+/// A region may only appear in the queue once. Pushing a region already in the queue retains the original queue time
+/// so repeated pushes do not reset the staleness.
+class ohm_API RegionScheduler
+{
+public:
+  /// Clock used to track region staleness.
+  using Clock = std::chrono::steady_clock;
+
+  /// Constructor.
+  RegionScheduler();
+  /// Destructor.
+  ~RegionScheduler();
+
+  /// Set the reference position used to prioritise regions. Must be in the same frame as the target map.
+  /// @param position The reference position.
+  void setReferencePosition(const glm::dvec3 &position);
+  /// Clear the reference position, reverting to oldest first ordering.
+  void clearReferencePosition();
+  /// Query the reference position. Only valid when @c hasReferencePosition() is true.
+  /// @return The reference position.
+  inline const glm::dvec3 &referencePosition() const { return reference_position_; }
+  /// Has a reference position been set?
+  /// @return True if a reference position has been set.
+  inline bool hasReferencePosition() const { return has_reference_position_; }
+
+  /// Set the radius around the reference position within which regions are always processed first.
+  /// @param radius The priority radius (metres). Zero to disable.
+  inline void setPriorityRadius(double radius) { priority_radius_ = radius; }
+  /// Query the radius around the reference position within which regions are always processed first.
+  /// @return The priority radius (metres).
+  inline double priorityRadius() const { return priority_radius_; }
+
+  /// Set the cost reduction applied for each second a region spends in the queue. This is effectively a distance
+  /// equivalent for staleness: with a weight of 1, a region which has waited for 10 seconds is prioritised equally with
+  /// a new region 10 metres closer to the reference position.
+  /// @param weight The staleness weight (metres per second).
+  inline void setStalenessWeight(double weight) { staleness_weight_ = weight; }
+  /// Query the staleness weight.
+  /// @return The staleness weight (metres per second).
+  inline double stalenessWeight() const { return staleness_weight_; }
+
+  /// Add a region to the queue. Does nothing if the region is already queued.
+  /// @param region_key The key of the region to add.
+  /// @return True if the region was added, false if already queued.
+  bool push(const glm::i16vec3 &region_key);
+
+  /// Add the regions in @p map where the @c MapChunk::touched_stamps for the @p target_layer are older than the stamps
+  /// for the @p source_layer . That is, where the @p target_layer is derived from the @p source_layer and is out of
+  /// date.
+  ///
+  /// Each such region is pushed along with its neighbours within @p region_padding regions. Padding regions are added
+  /// whether or not they exist in the map.
+  ///
+  /// @param map The map to search for out of date regions.
+  /// @param source_layer Index of the source layer.
+  /// @param target_layer Index of the derived layer to update.
+  /// @param region_padding Number of neighbouring regions to additionally push along each axis.
+  /// @return The number of regions added to the queue.
+  unsigned pushDirtyRegions(const OccupancyMap &map, int source_layer, int target_layer, int region_padding = 0);
+
+  /// Remove and return the highest priority region.
+  /// @param map The map the regions belong to. Used to resolve region positions.
+  /// @param[out] region_key Set to the key of the popped region.
+  /// @return True if a region was popped, false when the queue is empty.
+  bool pop(const OccupancyMap &map, glm::i16vec3 *region_key);
+
+  /// Query the number of queued regions.
+  /// @return The queue size.
+  inline size_t size() const { return queue_.size(); }
+  /// Is the queue empty?
+  /// @return True if nothing is queued.
+  inline bool empty() const { return queue_.empty(); }
+  /// Clear the queue.
+  void clear();
+
+private:
+  std::unordered_map<glm::i16vec3, Clock::time_point, MapRegion::Hash> queue_;
+  glm::dvec3 reference_position_{ 0.0 };
+  double priority_radius_ = 0;
+  double staleness_weight_ = 1.0;
+  bool has_reference_position_ = false;
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONSCHEDULER_H
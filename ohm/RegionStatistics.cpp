@@ -0,0 +1,125 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RegionStatistics.h"
+
+#include "MapChunk.h"
+#include "VoxelBuffer.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrder.h"
+
+#include "private/OccupancyMapDetail.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace ohm
+{
+void RegionStatistics::build(const MapChunk &chunk)
+{
+  const OccupancyMapDetail &map = *chunk.map;
+  layer_index = map.layout.occupancyLayer();
+  occupancy_threshold = map.occupancy_threshold_value;
+  occupied_count = free_count = unobserved_count = 0;
+  min_observed = glm::ivec3(std::numeric_limits<int>::max());
+  max_observed = glm::ivec3(-1);
+  min_occupied = glm::ivec3(std::numeric_limits<int>::max());
+  max_occupied = glm::ivec3(-1);
+
+  if (layer_index < 0)
+  {
+    stamp = 0;
+    return;
+  }
+
+  // Capture the stamp before reading the voxels so we err on the side of rebuilding on concurrent modification.
+  stamp = chunk.layerTouchedStamp(unsigned(layer_index));
+
+  const glm::ivec3 region_dimensions(map.region_voxel_dimensions);
+  VoxelBuffer<const VoxelBlock> occupancy_buffer(chunk.voxel_blocks[layer_index]);
+  const VoxelOrder order = resolveVoxelOrder(voxelOrderFromFlags(map.flags), region_dimensions);
+  glm::ivec3 local_key;
+  for (local_key.z = 0; local_key.z < region_dimensions.z; ++local_key.z)
+  {
+    for (local_key.y = 0; local_key.y < region_dimensions.y; ++local_key.y)
+    {
+      for (local_key.x = 0; local_key.x < region_dimensions.x; ++local_key.x)
+      {
+        float occupancy = unobservedOccupancyValue();
+        occupancy_buffer.readVoxel(voxelIndex(glm::u8vec3(local_key), region_dimensions, order), &occupancy);
+        if (occupancy == unobservedOccupancyValue())
+        {
+          ++unobserved_count;
+          continue;
+        }
+
+        if (occupancy >= occupancy_threshold)
+        {
+          ++occupied_count;
+          min_occupied = glm::min(min_occupied, local_key);
+          max_occupied = glm::max(max_occupied, local_key);
+        }
+        else
+        {
+          ++free_count;
+        }
+        min_observed = glm::min(min_observed, local_key);
+        max_observed = glm::max(max_observed, local_key);
+      }
+    }
+  }
+
+  if (!observed())
+  {
+    min_observed = glm::ivec3(0);
+  }
+  if (!occupied())
+  {
+    min_occupied = glm::ivec3(0);
+  }
+}
+
+
+bool RegionStatistics::isCurrent(const MapChunk &chunk) const
+{
+  const OccupancyMapDetail &map = *chunk.map;
+  return layer_index >= 0 && layer_index == map.layout.occupancyLayer() &&
+         occupancy_threshold == map.occupancy_threshold_value &&
+         occupied_count + free_count + unobserved_count == size_t(map.region_voxel_dimensions.x) *
+                                                              size_t(map.region_voxel_dimensions.y) *
+                                                              size_t(map.region_voxel_dimensions.z) &&
+         stamp == chunk.layerTouchedStamp(unsigned(layer_index));
+}
+
+
+const RegionStatistics *updateRegionStatistics(MapChunk &chunk, bool *rebuilt)
+{
+  if (rebuilt)
+  {
+    *rebuilt = false;
+  }
+
+  if (!chunk.map || chunk.map->layout.occupancyLayer() < 0)
+  {
+    return nullptr;
+  }
+
+  if (!chunk.statistics)
+  {
+    chunk.statistics = std::make_unique<RegionStatistics>();
+  }
+
+  if (!chunk.statistics->isCurrent(chunk))
+  {
+    chunk.statistics->build(chunk);
+    if (rebuilt)
+    {
+      *rebuilt = true;
+    }
+  }
+
+  return chunk.statistics.get();
+}
+}  // namespace ohm
@@ -0,0 +1,108 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONSTATISTICS_H
+#define OHM_REGIONSTATISTICS_H
+
+#include "OhmConfig.h"
+
+#include "KeyRange.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ohm
+{
+struct MapChunk;
+
+/// Occupancy statistics for the voxels of a single @c MapChunk .
+///
+/// Statistics are cached in the @c MapChunk::statistics and rebuilt by @c updateRegionStatistics() only when the
+/// occupancy layer has been touched since the last build, as shown by @c MapChunk::layerTouchedStamp() . This covers
+/// CPU updates, such as from a @c RayMapper , and GPU updates synced back to the chunk, both of which touch the layer.
+/// Gathering map statistics repeatedly therefore only examines the voxels of regions modified in the interim.
+/// The statistics use local voxel keys, so they remain current across an @c OccupancyMap::rebaseOrigin() .
+struct ohm_API RegionStatistics
+{
+  /// Number of occupied voxels.
+  size_t occupied_count = 0;
+  /// Number of observed voxels which are not occupied.
+  size_t free_count = 0;
+  /// Number of unobserved voxels.
+  size_t unobserved_count = 0;
+  /// Minimum local voxel key of the observed voxels. Only valid when @c observed() .
+  glm::ivec3 min_observed{ 0 };
+  /// Maximum local voxel key of the observed voxels, inclusive. Only valid when @c observed() .
+  glm::ivec3 max_observed{ -1 };
+  /// Minimum local voxel key of the occupied voxels. Only valid when @c occupied() .
+  glm::ivec3 min_occupied{ 0 };
+  /// Maximum local voxel key of the occupied voxels, inclusive. Only valid when @c occupied() .
+  glm::ivec3 max_occupied{ -1 };
+  /// The occupancy layer touch stamp when the statistics were built.
+  uint64_t stamp = 0;
+  /// The occupancy threshold used to classify voxels.
+  float occupancy_threshold = 0;
+  /// The occupancy layer index used in the build. Negative before the first build.
+  int layer_index = -1;
+
+  /// Query if the region contains any observed voxels.
+  /// @return True when there is at least one occupied or free voxel.
+  inline bool observed() const { return occupied_count + free_count > 0; }
+
+  /// Query if the region contains any occupied voxels.
+  /// @return True when there is at least one occupied voxel.
+  inline bool occupied() const { return occupied_count > 0; }
+
+  /// (Re)build the statistics from the occupancy layer of @p chunk .
+  /// @param chunk The chunk to analyse.
+  void build(const MapChunk &chunk);
+
+  /// Query if the statistics are up to date with the occupancy layer of @p chunk and the occupancy threshold.
+  /// @param chunk The chunk of interest. Must be the chunk which owns these statistics.
+  /// @return True if the statistics are current.
+  bool isCurrent(const MapChunk &chunk) const;
+};
+
+/// Occupancy statistics for an @c OccupancyMap as reported by @c OccupancyMap::calculateStatistics() .
+struct ohm_API MapStatistics
+{
+  /// Number of regions in the map.
+  size_t region_count = 0;
+  /// Number of regions with at least one observed voxel.
+  size_t observed_region_count = 0;
+  /// Number of occupied voxels.
+  size_t occupied_count = 0;
+  /// Number of observed voxels which are not occupied.
+  size_t free_count = 0;
+  /// Number of unobserved voxels within the existing regions.
+  size_t unobserved_count = 0;
+  /// Number of regions for which the cached @c RegionStatistics were rebuilt in gathering these statistics.
+  size_t rebuilt_region_count = 0;
+  /// The tight key range enclosing all observed voxels. Invalid when there are no observed voxels.
+  KeyRange observed_keys;
+  /// Minimum corner of the spatial extents enclosing all observed voxels. Only valid when @c observed() .
+  glm::dvec3 min_observed{ 0 };
+  /// Maximum corner of the spatial extents enclosing all observed voxels. Only valid when @c observed() .
+  glm::dvec3 max_observed{ 0 };
+
+  /// Query if the map contains any observed voxels.
+  /// @return True when there is at least one occupied or free voxel.
+  inline bool observed() const { return observed_region_count > 0; }
+};
+
+/// Update the @c MapChunk::statistics for @p chunk if required. This builds the statistics if missing or out of date
+/// with the chunk's occupancy layer.
+///
+/// Not threadsafe: the chunk must not be modified or analysed concurrently.
+///
+/// @param chunk The chunk to update the statistics for.
+/// @param[out] rebuilt Set to true if the statistics were rebuilt. May be null.
+/// @return The up to date statistics, or null if the map has no occupancy layer.
+const RegionStatistics ohm_API *updateRegionStatistics(MapChunk &chunk, bool *rebuilt = nullptr);
+}  // namespace ohm
+
+#endif  // OHM_REGIONSTATISTICS_H
@@ -0,0 +1,607 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RoiRangeFillCpu.h"
+
+#include "DefaultLayer.h"
+#include "MapChunk.h"
+#include "MapLayout.h"
+#include "Mutex.h"
+#include "OccupancyMap.h"
+#include "QueryFlag.h"
+#include "TaskArena.h"
+#include "VoxelBlock.h"
+#include "VoxelBuffer.h"
+#include "VoxelClearanceChannels.h"
+#include "VoxelOccupancy.h"
+
+#include <glm/glm.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace ohm
+{
+namespace
+{
+constexpr float kNoObstacle = std::numeric_limits<float>::infinity();
+
+/// Calculate the squared, scaled length of a voxel offset.
+inline float scaledRangeSqr(int x, int y, int z, const glm::vec3 &scaling)
+{
+  const float sx = float(x) * scaling.x;
+  const float sy = float(y) * scaling.y;
+  const float sz = float(z) * scaling.z;
+  return sx * sx + sy * sy + sz * sz;
+}
+
+
+/// Convert a voxel coordinate relative to the ROI to a work buffer index.
+inline unsigned workIndex(int x, int y, int z, const glm::ivec3 &dim)
+{
+  return unsigned(x + (y + z * dim.y) * dim.x);
+}
+
+
+/// Invoke @p func for each index in [0, count), splitting across threads when @p use_threads is set.
+void parallelFor(int count, bool use_threads, const std::function<void(int, int)> &func)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<int>(0, count),
+                        [&func](const tbb::blocked_range<int> &range) { func(range.begin(), range.end()); });
+    });
+    return;
+  }
+#else   // OHM_FEATURE_THREADS
+  (void)use_threads;
+#endif  // OHM_FEATURE_THREADS
+  func(0, count);
+}
+}  // namespace
+
+
+void RoiRangeFillCpu::WorkBuffer::resize(size_t count)
+{
+  x.resize(count);
+  y.resize(count);
+  z.resize(count);
+  range_sqr.resize(count);
+}
+
+
+RoiRangeFillCpu::RoiRangeFillCpu() = default;
+
+
+RoiRangeFillCpu::~RoiRangeFillCpu() = default;
+
+
+bool RoiRangeFillCpu::useThreads() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return use_threads_;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+bool RoiRangeFillCpu::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &region_key)
+{
+  if (map.layout().occupancyLayer() < 0 || map.layout().clearanceLayer() < 0 || !map.region(region_key, false))
+  {
+    return false;
+  }
+
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  const size_t voxel_count = size_t(dim.x) * size_t(dim.y) * size_t(dim.z);
+  // Offsets are stored as int16_t. Limit the padding to keep in range, allowing for the region dimensions.
+  const int max_padding = std::numeric_limits<int16_t>::max() - 2 * std::max(dim.x, std::max(dim.y, dim.z));
+  const int voxel_padding =
+    std::min(int(std::ceil(search_radius_ / float(map.resolution()))), std::max(max_padding, 0));
+
+  work_[0].resize(voxel_count);
+  work_[1].resize(voxel_count);
+
+  seedRegion(map, region_key, work_[0]);
+  seedOuterRegions(map, region_key, voxel_padding, work_[0]);
+
+  // Each iteration propagates obstacles by one voxel. There is no need to go further than the search range or the
+  // distance required to cross the ROI.
+  const int iterations = std::min(voxel_padding, std::max(dim.x, std::max(dim.y, dim.z)));
+  int src_index = 0;
+  for (int i = 0; i < iterations; ++i)
+  {
+    propagate(work_[src_index], work_[1 - src_index], dim);
+    src_index = 1 - src_index;
+  }
+
+  migrate(map, region_key, work_[src_index]);
+
+  if (calculate_channels_)
+  {
+    calculateChannelsForRegion(map, region_key);
+  }
+  return true;
+}
+
+
+bool RoiRangeFillCpu::calculateChannelsForRegion(OccupancyMap &map, const glm::i16vec3 &region_key)
+{
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int channels_layer = map.layout().layerIndex(default_layer::clearanceChannelsLayerName());
+  MapChunk *chunk = map.region(region_key, false);
+  if (occupancy_layer < 0 || channels_layer < 0 || !chunk)
+  {
+    return false;
+  }
+
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  const VoxelOrder order = map.layerVoxelOrder(occupancy_layer);
+  const bool unknown_as_occupied = (query_flags_ & kQfUnknownAsOccupied) != 0;
+  const float threshold = map.occupancyThresholdValue();
+  // Offsets are stored as int16_t, as for the clearance calculation.
+  const int max_padding = std::numeric_limits<int16_t>::max() - 2 * std::max(dim.x, std::max(dim.y, dim.z));
+  const int voxel_padding =
+    std::min(int(std::ceil(search_radius_ / float(map.resolution()))), std::max(max_padding, 0));
+
+  // Build the obstructions affecting the channels: the region padded in X and Y and above in Z. Coordinates in the
+  // padded volume are offset by voxel_padding in X and Y.
+  const glm::ivec3 padded_dim(dim.x + 2 * voxel_padding, dim.y + 2 * voxel_padding, dim.z + voxel_padding);
+  const glm::ivec3 padded_offset(-voxel_padding, -voxel_padding, 0);
+  std::vector<uint8_t> obstructed(size_t(padded_dim.x) * size_t(padded_dim.y) * size_t(padded_dim.z), 0u);
+
+  const glm::ivec3 region_padding = (glm::ivec3(voxel_padding) + dim - glm::ivec3(1)) / dim;
+  std::vector<glm::ivec3> neighbours;
+  for (int z = 0; z <= region_padding.z; ++z)
+  {
+    for (int y = -region_padding.y; y <= region_padding.y; ++y)
+    {
+      for (int x = -region_padding.x; x <= region_padding.x; ++x)
+      {
+        neighbours.emplace_back(x, y, z);
+      }
+    }
+  }
+
+  const auto collect_func = [&](int begin, int end) {
+    for (int i = begin; i < end; ++i)
+    {
+      const glm::ivec3 &neighbour = neighbours[i];
+      const glm::i16vec3 neighbour_key = glm::ivec3(region_key) + neighbour;
+      const MapChunk *neighbour_chunk = map.region(neighbour_key);
+      if (!neighbour_chunk && !unknown_as_occupied)
+      {
+        continue;
+      }
+
+      // Intersect the neighbour with the padded volume. Start and end are in neighbour local coordinates.
+      const glm::ivec3 offset = neighbour * dim;
+      const glm::ivec3 start = glm::max(padded_offset - offset, glm::ivec3(0));
+      const glm::ivec3 end = glm::min(padded_offset + padded_dim - offset, dim);
+
+      VoxelBuffer<const VoxelBlock> occupancy_buffer;
+      if (neighbour_chunk)
+      {
+        occupancy_buffer = VoxelBuffer<const VoxelBlock>(neighbour_chunk->voxel_blocks[occupancy_layer]);
+      }
+
+      for (int z = start.z; z < end.z; ++z)
+      {
+        for (int y = start.y; y < end.y; ++y)
+        {
+          for (int x = start.x; x < end.x; ++x)
+          {
+            bool obstacle = unknown_as_occupied;
+            if (occupancy_buffer.isValid())
+            {
+              float occupancy = 0;
+              occupancy_buffer.readVoxel(voxelIndex(glm::u8vec3(x, y, z), dim, order), &occupancy);
+              obstacle = (occupancy != unobservedOccupancyValue()) ? occupancy >= threshold : unknown_as_occupied;
+            }
+
+            // Neighbours do not overlap, so each thread writes distinct entries.
+            const glm::ivec3 padded = glm::ivec3(x, y, z) + offset - padded_offset;
+            obstructed[workIndex(padded.x, padded.y, padded.z, padded_dim)] = (obstacle) ? 1u : 0u;
+          }
+        }
+      }
+    }
+  };
+
+  parallelFor(int(neighbours.size()), useThreads(), collect_func);
+
+  const glm::vec3 report_scaling =
+    glm::vec3(float(map.resolution())) *
+    (((query_flags_ & kQfReportUnscaledResults) != 0) ? glm::vec3(1.0f) : axis_scaling_);
+  const float search_radius = search_radius_;
+  const VoxelOrder channels_order = map.layerVoxelOrder(channels_layer);
+  VoxelBuffer<VoxelBlock> channels_buffer(chunk->voxel_blocks[channels_layer]);
+
+  const auto in_range = [search_radius](float range) {
+    return (search_radius <= 0 || range <= search_radius) ? range : -1.0f;
+  };
+
+  const auto channels_func = [&](int z_begin, int z_end) {
+    // Horizontal channel work buffers for a single padded voxel layer.
+    const glm::ivec3 plane_dim(padded_dim.x, padded_dim.y, 1);
+    const size_t plane_size = size_t(plane_dim.x) * size_t(plane_dim.y);
+    std::array<std::vector<int16_t>, 2> offset_x;
+    std::array<std::vector<int16_t>, 2> offset_y;
+    std::array<std::vector<float>, 2> range_sqr;
+    for (int i = 0; i < 2; ++i)
+    {
+      offset_x[i].resize(plane_size);
+      offset_y[i].resize(plane_size);
+      range_sqr[i].resize(plane_size);
+    }
+
+    for (int z = z_begin; z < z_end; ++z)
+    {
+      // Seed the layer.
+      for (size_t i = 0; i < plane_size; ++i)
+      {
+        offset_x[0][i] = offset_y[0][i] = 0;
+        range_sqr[0][i] = (obstructed[i + size_t(z) * plane_size]) ? 0.0f : kNoObstacle;
+      }
+
+      // Propagate within the layer.
+      int src = 0;
+      for (int iteration = 0; iteration < voxel_padding; ++iteration)
+      {
+        const int dst = 1 - src;
+        for (int y = 0; y < plane_dim.y; ++y)
+        {
+          for (int x = 0; x < plane_dim.x; ++x)
+          {
+            const unsigned index = workIndex(x, y, 0, plane_dim);
+            int16_t best_x = offset_x[src][index];
+            int16_t best_y = offset_y[src][index];
+            float best_range = range_sqr[src][index];
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, plane_dim.y - 1); ++ny)
+            {
+              for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, plane_dim.x - 1); ++nx)
+              {
+                const unsigned neighbour = workIndex(nx, ny, 0, plane_dim);
+                if (range_sqr[src][neighbour] < kNoObstacle)
+                {
+                  const auto ox = int16_t(offset_x[src][neighbour] + nx - x);
+                  const auto oy = int16_t(offset_y[src][neighbour] + ny - y);
+                  const float candidate = scaledRangeSqr(ox, oy, 0, axis_scaling_);
+                  if (candidate < best_range)
+                  {
+                    best_x = ox;
+                    best_y = oy;
+                    best_range = candidate;
+                  }
+                }
+              }
+            }
+            offset_x[dst][index] = best_x;
+            offset_y[dst][index] = best_y;
+            range_sqr[dst][index] = best_range;
+          }
+        }
+        src = dst;
+      }
+
+      for (int y = 0; y < dim.y; ++y)
+      {
+        for (int x = 0; x < dim.x; ++x)
+        {
+          const unsigned index = workIndex(x + voxel_padding, y + voxel_padding, 0, plane_dim);
+          VoxelClearanceChannels channels{ -1.0f, -1.0f };
+          if (range_sqr[src][index] < kNoObstacle)
+          {
+            channels.horizontal =
+              std::sqrt(scaledRangeSqr(offset_x[src][index], offset_y[src][index], 0, report_scaling));
+          }
+
+          // Overhead channel: walk up the column to the nearest obstruction.
+          for (int oz = 0; z + oz < padded_dim.z && oz <= voxel_padding; ++oz)
+          {
+            if (obstructed[workIndex(x + voxel_padding, y + voxel_padding, z + oz, padded_dim)])
+            {
+              channels.overhead = float(oz) * report_scaling.z;
+              break;
+            }
+          }
+
+          channels.horizontal = in_range(channels.horizontal);
+          channels.overhead = in_range(channels.overhead);
+          channels_buffer.writeVoxel(voxelIndex(glm::u8vec3(x, y, z), dim, channels_order), channels);
+        }
+      }
+    }
+  };
+
+  parallelFor(dim.z, useThreads(), channels_func);
+
+  const uint64_t stamp = map.touch();
+  chunk->touched_stamps[channels_layer] = stamp;
+  chunk->markDirty(stamp);
+  return true;
+}
+
+
+void RoiRangeFillCpu::seedRegion(const OccupancyMap &map, const glm::i16vec3 &region_key, WorkBuffer &work) const
+{
+  const MapChunk *chunk = map.region(region_key);
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  const VoxelOrder order = map.layerVoxelOrder(occupancy_layer);
+  const bool unknown_as_occupied = (query_flags_ & kQfUnknownAsOccupied) != 0;
+  const float threshold = map.occupancyThresholdValue();
+
+  VoxelBuffer<const VoxelBlock> occupancy_buffer(chunk->voxel_blocks[occupancy_layer]);
+
+  const auto seed_func = [&](int z_begin, int z_end) {
+    for (int z = z_begin; z < z_end; ++z)
+    {
+      for (int y = 0; y < dim.y; ++y)
+      {
+        for (int x = 0; x < dim.x; ++x)
+        {
+          float occupancy = 0;
+          occupancy_buffer.readVoxel(voxelIndex(glm::u8vec3(x, y, z), dim, order), &occupancy);
+          const bool obstacle =
+            (occupancy != unobservedOccupancyValue()) ? occupancy >= threshold : unknown_as_occupied;
+          const unsigned index = workIndex(x, y, z, dim);
+          work.x[index] = work.y[index] = work.z[index] = 0;
+          work.range_sqr[index] = (obstacle) ? 0.0f : kNoObstacle;
+        }
+      }
+    }
+  };
+
+  parallelFor(dim.z, useThreads(), seed_func);
+}
+
+
+void RoiRangeFillCpu::seedOuterRegions(const OccupancyMap &map, const glm::i16vec3 &region_key, int voxel_padding,
+                                       WorkBuffer &work) const
+{
+  if (voxel_padding <= 0)
+  {
+    return;
+  }
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  const VoxelOrder order = map.layerVoxelOrder(occupancy_layer);
+  const bool unknown_as_occupied = (query_flags_ & kQfUnknownAsOccupied) != 0;
+  const float threshold = map.occupancyThresholdValue();
+
+  // Build the list of neighbouring regions overlapping the padding.
+  const glm::ivec3 region_padding = (glm::ivec3(voxel_padding) + dim - glm::ivec3(1)) / dim;
+  std::vector<glm::ivec3> neighbours;
+  for (int z = -region_padding.z; z <= region_padding.z; ++z)
+  {
+    for (int y = -region_padding.y; y <= region_padding.y; ++y)
+    {
+      for (int x = -region_padding.x; x <= region_padding.x; ++x)
+      {
+        if (x || y || z)
+        {
+          neighbours.emplace_back(x, y, z);
+        }
+      }
+    }
+  }
+
+  // Collect obstacles in the padding, converted to coordinates relative to the ROI.
+  std::vector<glm::ivec3> obstacles;
+  Mutex obstacles_lock;
+
+  const auto collect_func = [&](int begin, int end) {
+    std::vector<glm::ivec3> local_obstacles;
+    for (int i = begin; i < end; ++i)
+    {
+      const glm::ivec3 &neighbour = neighbours[i];
+      const glm::i16vec3 neighbour_key = glm::ivec3(region_key) + neighbour;
+      const MapChunk *chunk = map.region(neighbour_key);
+      if (!chunk && !unknown_as_occupied)
+      {
+        continue;
+      }
+
+      // Intersect the neighbour with the padded ROI. Start and end are in neighbour local coordinates.
+      const glm::ivec3 offset = neighbour * dim;
+      const glm::ivec3 start = glm::max(glm::ivec3(-voxel_padding) - offset, glm::ivec3(0));
+      const glm::ivec3 end = glm::min(dim + glm::ivec3(voxel_padding) - offset, dim);
+
+      VoxelBuffer<const VoxelBlock> occupancy_buffer;
+      if (chunk)
+      {
+        occupancy_buffer = VoxelBuffer<const VoxelBlock>(chunk->voxel_blocks[occupancy_layer]);
+      }
+
+      for (int z = start.z; z < end.z; ++z)
+      {
+        for (int y = start.y; y < end.y; ++y)
+        {
+          for (int x = start.x; x < end.x; ++x)
+          {
+            bool obstacle = unknown_as_occupied;
+            if (occupancy_buffer.isValid())
+            {
+              float occupancy = 0;
+              occupancy_buffer.readVoxel(voxelIndex(glm::u8vec3(x, y, z), dim, order), &occupancy);
+              obstacle = (occupancy != unobservedOccupancyValue()) ? occupancy >= threshold : unknown_as_occupied;
+            }
+
+            if (obstacle)
+            {
+              local_obstacles.emplace_back(glm::ivec3(x, y, z) + offset);
+            }
+          }
+        }
+      }
+    }
+
+    if (!local_obstacles.empty())
+    {
+      std::unique_lock<Mutex> guard(obstacles_lock);
+      obstacles.insert(obstacles.end(), local_obstacles.begin(), local_obstacles.end());
+    }
+  };
+
+  parallelFor(int(neighbours.size()), useThreads(), collect_func);
+
+  // Seed each obstacle into the ROI voxels neighbouring the nearest ROI voxel. Propagation does the rest.
+  for (const glm::ivec3 &obstacle : obstacles)
+  {
+    const glm::ivec3 nearest = glm::clamp(obstacle, glm::ivec3(0), dim - glm::ivec3(1));
+    const glm::ivec3 start = glm::max(nearest - glm::ivec3(1), glm::ivec3(0));
+    const glm::ivec3 end = glm::min(nearest + glm::ivec3(2), dim);
+    for (int z = start.z; z < end.z; ++z)
+    {
+      for (int y = start.y; y < end.y; ++y)
+      {
+        for (int x = start.x; x < end.x; ++x)
+        {
+          const glm::ivec3 separation = obstacle - glm::ivec3(x, y, z);
+          const float range_sqr = scaledRangeSqr(separation.x, separation.y, separation.z, axis_scaling_);
+          const unsigned index = workIndex(x, y, z, dim);
+          if (range_sqr < work.range_sqr[index])
+          {
+            work.x[index] = int16_t(separation.x);
+            work.y[index] = int16_t(separation.y);
+            work.z[index] = int16_t(separation.z);
+            work.range_sqr[index] = range_sqr;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+void RoiRangeFillCpu::propagate(const WorkBuffer &src, WorkBuffer &dst, const glm::ivec3 &dim) const
+{
+  const glm::vec3 scaling = axis_scaling_;
+
+  const auto propagate_func = [&](int z_begin, int z_end) {
+    for (int z = z_begin; z < z_end; ++z)
+    {
+      for (int y = 0; y < dim.y; ++y)
+      {
+        const unsigned row = workIndex(0, y, z, dim);
+        int16_t *__restrict dst_x = dst.x.data() + row;
+        int16_t *__restrict dst_y = dst.y.data() + row;
+        int16_t *__restrict dst_z = dst.z.data() + row;
+        float *__restrict dst_range = dst.range_sqr.data() + row;
+
+        std::copy(src.x.begin() + row, src.x.begin() + row + dim.x, dst_x);
+        std::copy(src.y.begin() + row, src.y.begin() + row + dim.x, dst_y);
+        std::copy(src.z.begin() + row, src.z.begin() + row + dim.x, dst_z);
+        std::copy(src.range_sqr.begin() + row, src.range_sqr.begin() + row + dim.x, dst_range);
+
+        for (int nz = -1; nz <= 1; ++nz)
+        {
+          if (z + nz < 0 || z + nz >= dim.z)
+          {
+            continue;
+          }
+
+          for (int ny = -1; ny <= 1; ++ny)
+          {
+            if (y + ny < 0 || y + ny >= dim.y)
+            {
+              continue;
+            }
+
+            const unsigned neighbour_row = workIndex(0, y + ny, z + nz, dim);
+            for (int nx = -1; nx <= 1; ++nx)
+            {
+              if (!nx && !ny && !nz)
+              {
+                continue;
+              }
+
+              // Process the row range for which the neighbour is in the ROI. The loop body is branch free so it may be
+              // vectorised.
+              const int x_begin = (nx < 0) ? 1 : 0;
+              const int x_end = (nx > 0) ? dim.x - 1 : dim.x;
+              const int16_t *__restrict src_x = src.x.data() + neighbour_row + nx;
+              const int16_t *__restrict src_y = src.y.data() + neighbour_row + nx;
+              const int16_t *__restrict src_z = src.z.data() + neighbour_row + nx;
+              const float *__restrict src_range = src.range_sqr.data() + neighbour_row + nx;
+              for (int x = x_begin; x < x_end; ++x)
+              {
+                const int16_t ox = int16_t(src_x[x] + nx);
+                const int16_t oy = int16_t(src_y[x] + ny);
+                const int16_t oz = int16_t(src_z[x] + nz);
+                const float sx = float(ox) * scaling.x;
+                const float sy = float(oy) * scaling.y;
+                const float sz = float(oz) * scaling.z;
+                const float candidate = (src_range[x] < kNoObstacle) ? sx * sx + sy * sy + sz * sz : kNoObstacle;
+                const bool closer = candidate < dst_range[x];
+                dst_x[x] = (closer) ? ox : dst_x[x];
+                dst_y[x] = (closer) ? oy : dst_y[x];
+                dst_z[x] = (closer) ? oz : dst_z[x];
+                dst_range[x] = (closer) ? candidate : dst_range[x];
+              }
+            }
+          }
+        }
+      }
+    }
+  };
+
+  parallelFor(dim.z, useThreads(), propagate_func);
+}
+
+
+void RoiRangeFillCpu::migrate(OccupancyMap &map, const glm::i16vec3 &region_key, const WorkBuffer &work) const
+{
+  MapChunk *chunk = map.region(region_key);
+  const int clearance_layer = map.layout().clearanceLayer();
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  const VoxelOrder order = map.layerVoxelOrder(clearance_layer);
+  const glm::vec3 report_scaling =
+    glm::vec3(float(map.resolution())) *
+    (((query_flags_ & kQfReportUnscaledResults) != 0) ? glm::vec3(1.0f) : axis_scaling_);
+  const float search_radius = search_radius_;
+
+  VoxelBuffer<VoxelBlock> clearance_buffer(chunk->voxel_blocks[clearance_layer]);
+
+  const auto migrate_func = [&](int z_begin, int z_end) {
+    for (int z = z_begin; z < z_end; ++z)
+    {
+      for (int y = 0; y < dim.y; ++y)
+      {
+        for (int x = 0; x < dim.x; ++x)
+        {
+          const unsigned index = workIndex(x, y, z, dim);
+          float range = -1.0f;
+          if (work.range_sqr[index] < kNoObstacle)
+          {
+            range = std::sqrt(scaledRangeSqr(work.x[index], work.y[index], work.z[index], report_scaling));
+            range = (search_radius <= 0 || range <= search_radius) ? range : -1.0f;
+          }
+          clearance_buffer.writeVoxel(voxelIndex(glm::u8vec3(x, y, z), dim, order), range);
+        }
+      }
+    }
+  };
+
+  parallelFor(dim.z, useThreads(), migrate_func);
+
+  const uint64_t stamp = map.touch();
+  chunk->touched_stamps[clearance_layer] = stamp;
+  chunk->markDirty(stamp);
+}
+}  // namespace ohm
@@ -0,0 +1,134 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_ROIRANGEFILLCPU_H
+#define OHM_ROIRANGEFILLCPU_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// CPU implementation of the ROI (region of interest) range fill algorithm used to calculate voxel clearance values:
+/// the range to the nearest obstructed voxel.
+///
+/// This matches the GPU @c RoiRangeFill algorithm described in @c clearance-performance-notes.md and writes the same
+/// results to the @c MapLayout::clearanceLayer() . For each region:
+/// -# Seed the ROI voxels, marking each obstructed voxel as its own nearest obstacle.
+/// -# Seed obstacles from the padding regions within the search range into the nearest ROI border voxels.
+/// -# Propagate obstacles by having each ROI voxel select the closest obstacle tracked by itself and its 26
+///    neighbours. This is iterated until the search range or the ROI extents are covered.
+/// -# Migrate the offsets to the nearest obstacles into the clearance layer.
+///
+/// Obstacle offsets are stored in a structure of arrays layout and propagation processes each voxel row with branch
+/// free loops the compiler can vectorise. Propagation and seeding are split across threads when built with
+/// @c OHM_FEATURE_THREADS and @c useThreads() is set. Offsets are stored using 16-bit values, supporting much larger
+/// search ranges than the GPU implementation.
+///
+/// Obstructed voxels are occupied voxels, or unobserved voxels with @c kQfUnknownAsOccupied set. The results are
+/// interpreted just as for the @c ClearanceProcess : zero for an obstructed voxel, the range to the nearest obstruction
+/// within the @c searchRadius() or -1 when there is no obstruction within range. Like the GPU algorithm, the results
+/// are an approximation and may be longer than the true range.
+class ohm_API RoiRangeFillCpu
+{
+public:
+  /// Constructor.
+  RoiRangeFillCpu();
+  /// Destructor.
+  ~RoiRangeFillCpu();
+
+  /// Get the per axis scaling applied when determining the closest obstructing voxel.
+  /// @return The axis scaling.
+  inline const glm::vec3 &axisScaling() const { return axis_scaling_; }
+  /// Set the per axis scaling applied when determining the closest obstructing voxel. See
+  /// @c ClearanceProcess::setAxisScaling() .
+  /// @param scaling The new axis scaling.
+  inline void setAxisScaling(const glm::vec3 &scaling) { axis_scaling_ = scaling; }
+
+  /// Get the search radius to which we look for obstructing voxels.
+  /// @return The search radius.
+  inline float searchRadius() const { return search_radius_; }
+  /// Set the search radius to which we look for obstructing voxels.
+  /// @param radius The new search radius.
+  inline void setSearchRadius(float radius) { search_radius_ = radius; }
+
+  /// Get the @c QueryFlag values. Only @c kQfUnknownAsOccupied and @c kQfReportUnscaledResults are used.
+  /// @return The query flags.
+  inline unsigned queryFlags() const { return query_flags_; }
+  /// Set the @c QueryFlag values.
+  /// @param flags The new query flags.
+  inline void setQueryFlags(unsigned flags) { query_flags_ = flags; }
+
+  /// Enable or disable multi-threaded calculation. Ignored unless built with @c OHM_FEATURE_THREADS .
+  /// @param use_threads True to enable threaded calculation.
+  inline void setUseThreads(bool use_threads) { use_threads_ = use_threads; }
+  /// Is multi-threaded calculation enabled? Always false when not built with @c OHM_FEATURE_THREADS .
+  /// @return True if threaded calculation is enabled and available.
+  bool useThreads() const;
+
+  /// Also calculate the @c VoxelClearanceChannels in @c calculateForRegion() ?
+  /// @return True to calculate the clearance channels.
+  inline bool calculateChannels() const { return calculate_channels_; }
+  /// Set whether @c calculateForRegion() also calculates the @c VoxelClearanceChannels . See
+  /// @c calculateChannelsForRegion() .
+  /// @param calculate True to calculate the clearance channels.
+  inline void setCalculateChannels(bool calculate) { calculate_channels_ = calculate; }
+
+  /// Calculate the clearance values for the region at @p region_key , writing the results to the
+  /// @c MapLayout::clearanceLayer() .
+  /// @param map The map to calculate for. Must have occupancy and clearance layers - see @c addClearance() .
+  /// @param region_key The key of the region to calculate clearance values for.
+  /// @return True on success, false if the region does not exist or the required layers are missing.
+  bool calculateForRegion(OccupancyMap &map, const glm::i16vec3 &region_key);
+
+  /// Calculate the @c VoxelClearanceChannels for the region at @p region_key , writing the results to the layer named
+  /// @c default_layer::clearanceChannelsLayerName() .
+  ///
+  /// The horizontal channel is propagated within each voxel layer, as for the GPU @c RoiRangeFill , while the overhead
+  /// channel is found with a single downwards pass over each voxel column. Only the voxels within the search range
+  /// horizontally or above the region are considered.
+  ///
+  /// @param map The map to calculate for. Must have occupancy and clearance channels layers - see
+  ///   @c addClearanceChannels() .
+  /// @param region_key The key of the region to calculate clearance channels for.
+  /// @return True on success, false if the region does not exist or the required layers are missing.
+  bool calculateChannelsForRegion(OccupancyMap &map, const glm::i16vec3 &region_key);
+
+private:
+  /// Working voxels in structure of arrays form. Each voxel tracks the offset to its nearest obstacle and the squared,
+  /// scaled range to that obstacle. The range is infinite when there is no known obstacle.
+  struct WorkBuffer
+  {
+    std::vector<int16_t> x;
+    std::vector<int16_t> y;
+    std::vector<int16_t> z;
+    std::vector<float> range_sqr;
+
+    void resize(size_t count);
+  };
+
+  void seedRegion(const OccupancyMap &map, const glm::i16vec3 &region_key, WorkBuffer &work) const;
+  void seedOuterRegions(const OccupancyMap &map, const glm::i16vec3 &region_key, int voxel_padding,
+                        WorkBuffer &work) const;
+  void propagate(const WorkBuffer &src, WorkBuffer &dst, const glm::ivec3 &dim) const;
+  void migrate(OccupancyMap &map, const glm::i16vec3 &region_key, const WorkBuffer &work) const;
+
+  std::array<WorkBuffer, 2> work_;
+  glm::vec3 axis_scaling_ = glm::vec3(1.0f);
+  float search_radius_ = 0.0f;
+  unsigned query_flags_ = 0;
+  bool use_threads_ = true;
+  bool calculate_channels_ = false;
+};
+}  // namespace ohm
+
+#endif  // OHM_ROIRANGEFILLCPU_H
@@ -0,0 +1,471 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ShardedMap.h"
+
+#include "MapChunk.h"
+#include "MapDelta.h"
+#include "MapSerialise.h"
+#include "NearestNeighbours.h"
+#include "RaysQuery.h"
+#include "TaskArena.h"
+#include "Voxel.h"
+#include "VoxelOccupancy.h"
+
+#include "private/ShardedMapDetail.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_set>
+
+namespace ohm
+{
+namespace
+{
+/// Invoke @p func for each shard, in parallel when enabled.
+void forEachShard(ShardedMapDetail &imp, const std::function<void(MapShard &)> &func)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (imp.use_threads && imp.shards.size() > 1)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(size_t(0), imp.shards.size(), [&imp, &func](size_t i) { func(imp.shards[i]); });
+    });
+    return;
+  }
+#endif  // OHM_FEATURE_THREADS
+  for (auto &shard : imp.shards)
+  {
+    func(shard);
+  }
+}
+
+
+unsigned shardIndexOf(const ShardedMapDetail &imp, const glm::i16vec3 &region_key)
+{
+  const int key = region_key[imp.axis];
+  return unsigned(std::upper_bound(imp.boundaries.begin(), imp.boundaries.end(), key) - imp.boundaries.begin());
+}
+
+
+/// Calculate the spatial coordinate along the partition axis at which the regions of the given @p boundary key start.
+double boundaryPlane(const ShardedMapDetail &imp, int boundary)
+{
+  glm::i16vec3 region_key(0);
+  region_key[imp.axis] = int16_t(std::max<int>(std::numeric_limits<int16_t>::min(),
+                                               std::min<int>(boundary, std::numeric_limits<int16_t>::max())));
+  return imp.shards.front().map->regionSpatialMin(region_key)[imp.axis];
+}
+
+
+/// Clip the ray @p origin to @p sample at the shard boundaries, adding a segment to each shard the ray passes through.
+/// The ends of clipped segments are pulled back from the boundary plane by a small epsilon so each segment only
+/// touches the voxels of its own shard.
+void clipRay(ShardedMapDetail &imp, const glm::dvec3 &origin, const glm::dvec3 &sample, size_t ray_index,
+             const float *intensities, const double *timestamps)
+{
+  const OccupancyMap &map = *imp.shards.front().map;
+  const unsigned origin_shard = shardIndexOf(imp, map.regionKey(origin));
+  const unsigned sample_shard = shardIndexOf(imp, map.regionKey(sample));
+  const glm::dvec3 dir = sample - origin;
+  const double length = glm::length(dir);
+
+  const auto add_segment = [&](unsigned shard_index, double from_t, double to_t, bool sample_end) {
+    MapShard &shard = imp.shards[shard_index];
+    shard.rays.emplace_back(origin + dir * from_t);
+    shard.rays.emplace_back((sample_end) ? sample : origin + dir * to_t);
+    shard.segments.emplace_back(ShardSegment{ ray_index, from_t * length, (to_t - from_t) * length, sample_end });
+    if (intensities)
+    {
+      shard.intensities.emplace_back(intensities[ray_index]);
+    }
+    if (timestamps)
+    {
+      shard.timestamps.emplace_back(timestamps[ray_index]);
+    }
+  };
+
+  if (origin_shard == sample_shard || dir[imp.axis] == 0)
+  {
+    add_segment(origin_shard, 0, 1, true);
+    return;
+  }
+
+  const double epsilon_t = 1e-3 * map.resolution() / length;  // NOLINT(readability-magic-numbers)
+  const int step = (sample_shard > origin_shard) ? 1 : -1;
+  double start_t = 0;
+  for (unsigned shard_index = origin_shard; shard_index != sample_shard;
+       shard_index = unsigned(int(shard_index) + step))
+  {
+    // The boundary between this shard and the next.
+    const int boundary = imp.boundaries[(step > 0) ? shard_index : shard_index - 1];
+    const double plane_t = (boundaryPlane(imp, boundary) - origin[imp.axis]) / dir[imp.axis];
+    const double end_t = std::max(start_t, std::min(1.0, plane_t - epsilon_t));
+    add_segment(shard_index, start_t, end_t, false);
+    start_t = std::max(start_t, std::min(1.0, plane_t + epsilon_t));
+  }
+  add_segment(sample_shard, start_t, 1, true);
+}
+}  // namespace
+
+
+ShardedMap::ShardedMap(const OccupancyMap &seed_map, unsigned shard_count, int axis, int regions_per_shard)
+  : imp_(std::make_unique<ShardedMapDetail>())
+{
+  shard_count = std::max(1u, shard_count);
+  imp_->axis = std::max(0, std::min(axis, 2));
+  imp_->shards.resize(shard_count);
+  for (MapShard &shard : imp_->shards)
+  {
+    shard.map = std::make_unique<OccupancyMap>(seed_map.resolution(), seed_map.regionVoxelDimensions(),
+                                               seed_map.flags(), seed_map.layout());
+    OccupancyMap &map = *shard.map;
+    map.setOrigin(seed_map.origin());
+    map.setHitValue(seed_map.hitValue());
+    map.setMissValue(seed_map.missValue());
+    map.setOccupancyThresholdProbability(seed_map.occupancyThresholdProbability());
+    map.setMinVoxelValue(seed_map.minVoxelValue());
+    map.setMaxVoxelValue(seed_map.maxVoxelValue());
+    map.setSaturateAtMinValue(seed_map.saturateAtMinValue());
+    map.setSaturateAtMaxValue(seed_map.saturateAtMaxValue());
+    shard.mapper = std::make_unique<RayMapperOccupancy>(&map);
+  }
+
+  // Split evenly around zero.
+  for (unsigned i = 0; i + 1 < shard_count; ++i)
+  {
+    imp_->boundaries.emplace_back((2 * int(i + 1) - int(shard_count)) * regions_per_shard / 2);
+  }
+}
+
+
+ShardedMap::~ShardedMap() = default;
+
+
+unsigned ShardedMap::shardCount() const
+{
+  return unsigned(imp_->shards.size());
+}
+
+
+OccupancyMap &ShardedMap::shard(unsigned index)
+{
+  return *imp_->shards[index].map;
+}
+
+
+const OccupancyMap &ShardedMap::shard(unsigned index) const
+{
+  return *imp_->shards[index].map;
+}
+
+
+int ShardedMap::axis() const
+{
+  return imp_->axis;
+}
+
+
+const std::vector<int> &ShardedMap::boundaries() const
+{
+  return imp_->boundaries;
+}
+
+
+int ShardedMap::setBoundaries(const std::vector<int> &boundaries)
+{
+  if (boundaries.size() + 1 != imp_->shards.size() || !std::is_sorted(boundaries.begin(), boundaries.end()))
+  {
+    return -1;
+  }
+
+  // Collect the regions changing owner, grouped by source and destination shard.
+  const size_t shard_count = imp_->shards.size();
+  std::vector<std::vector<std::vector<glm::i16vec3>>> moves(shard_count,
+                                                            std::vector<std::vector<glm::i16vec3>>(shard_count));
+  imp_->boundaries = boundaries;
+  std::vector<const MapChunk *> chunks;
+  for (unsigned src = 0; src < shard_count; ++src)
+  {
+    chunks.clear();
+    imp_->shards[src].map->enumerateRegions(chunks);
+    for (const MapChunk *chunk : chunks)
+    {
+      const unsigned dst = shardIndexOf(*imp_, chunk->region.coord);
+      if (dst != src)
+      {
+        moves[src][dst].emplace_back(chunk->region.coord);
+      }
+    }
+  }
+
+  // Transfer as map delta messages.
+  int moved_count = 0;
+  std::vector<uint8_t> message;
+  for (unsigned src = 0; src < shard_count; ++src)
+  {
+    OccupancyMap &src_map = *imp_->shards[src].map;
+    std::unordered_set<glm::i16vec3, MapRegion::Hash> moved_set;
+    for (unsigned dst = 0; dst < shard_count; ++dst)
+    {
+      const std::vector<glm::i16vec3> &region_keys = moves[src][dst];
+      if (region_keys.empty())
+      {
+        continue;
+      }
+
+      size_t encoded_count = 0;
+      if (encodeMapRegions(src_map, region_keys.data(), region_keys.size(), message, &encoded_count) != kSeOk ||
+          (encoded_count && applyMapDelta(*imp_->shards[dst].map, message.data(), message.size()) != kSeOk))
+      {
+        return -1;
+      }
+
+      moved_set.insert(region_keys.begin(), region_keys.end());
+      moved_count += int(encoded_count);
+    }
+
+    if (!moved_set.empty())
+    {
+      src_map.cullRegions(
+        [&moved_set](const MapChunk &chunk) { return moved_set.find(chunk.region.coord) != moved_set.end(); });
+    }
+  }
+
+  return moved_count;
+}
+
+
+unsigned ShardedMap::shardIndex(const glm::i16vec3 &region_key) const
+{
+  return shardIndexOf(*imp_, region_key);
+}
+
+
+unsigned ShardedMap::shardIndex(const glm::dvec3 &point) const
+{
+  return shardIndexOf(*imp_, imp_->shards.front().map->regionKey(point));
+}
+
+
+size_t ShardedMap::regionCount() const
+{
+  size_t count = 0;
+  for (const auto &shard : imp_->shards)
+  {
+    count += shard.map->regionCount();
+  }
+  return count;
+}
+
+
+size_t ShardedMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
+                                 const double *timestamps, unsigned ray_update_flags)
+{
+  // Scatter.
+  for (auto &shard : imp_->shards)
+  {
+    shard.clearBatch();
+  }
+  for (size_t i = 0; i + 1 < element_count; i += 2)
+  {
+    clipRay(*imp_, rays[i], rays[i + 1], i / 2, intensities, timestamps);
+  }
+
+  // Integrate the segments ending at the sample, then the clipped segments with their ends treated as free.
+  forEachShard(*imp_, [intensities, timestamps, ray_update_flags](MapShard &shard) {
+    std::vector<glm::dvec3> batch_rays;
+    std::vector<float> batch_intensities;
+    std::vector<double> batch_timestamps;
+    for (int sample_end = 1; sample_end >= 0; --sample_end)
+    {
+      batch_rays.clear();
+      batch_intensities.clear();
+      batch_timestamps.clear();
+      for (size_t i = 0; i < shard.segments.size(); ++i)
+      {
+        if (shard.segments[i].sample_end == bool(sample_end))
+        {
+          batch_rays.emplace_back(shard.rays[i * 2 + 0]);
+          batch_rays.emplace_back(shard.rays[i * 2 + 1]);
+          if (intensities)
+          {
+            batch_intensities.emplace_back(shard.intensities[i]);
+          }
+          if (timestamps)
+          {
+            batch_timestamps.emplace_back(shard.timestamps[i]);
+          }
+        }
+      }
+
+      if (!batch_rays.empty())
+      {
+        shard.mapper->integrateRays(batch_rays.data(), batch_rays.size(),
+                                    (intensities) ? batch_intensities.data() : nullptr,
+                                    (timestamps) ? batch_timestamps.data() : nullptr,
+                                    ray_update_flags | ((sample_end) ? 0u : unsigned(kRfEndPointAsFree)));
+      }
+    }
+  });
+
+  size_t segment_count = 0;
+  for (const auto &shard : imp_->shards)
+  {
+    segment_count += shard.segments.size();
+  }
+  return segment_count;
+}
+
+
+void ShardedMap::occupancy(const glm::dvec3 *points, size_t point_count, float *values) const
+{
+  // Scatter the point indices by shard.
+  std::vector<std::vector<size_t>> shard_points(imp_->shards.size());
+  for (size_t i = 0; i < point_count; ++i)
+  {
+    shard_points[shardIndex(points[i])].emplace_back(i);
+  }
+
+  // Each point is written by one shard only.
+  forEachShard(*imp_, [this, &shard_points, points, values](MapShard &shard) {
+    const OccupancyMap &map = *shard.map;
+    const auto shard_index = size_t(&shard - imp_->shards.data());
+    Voxel<const float> voxel(&map, map.layout().occupancyLayer());
+    for (const size_t point_index : shard_points[shard_index])
+    {
+      voxel.setKey(map.voxelKey(points[point_index]));
+      values[point_index] = (voxel.isValid()) ? voxel.data() : unobservedOccupancyValue();
+    }
+  });
+}
+
+
+void ShardedMap::raysQuery(const glm::dvec3 *rays, size_t element_count, std::vector<ShardedRayResult> &results,
+                           unsigned query_flags)
+{
+  for (auto &shard : imp_->shards)
+  {
+    shard.clearBatch();
+  }
+  for (size_t i = 0; i + 1 < element_count; i += 2)
+  {
+    clipRay(*imp_, rays[i], rays[i + 1], i / 2, nullptr, nullptr);
+  }
+
+  forEachShard(*imp_, [query_flags](MapShard &shard) {
+    if (shard.segments.empty())
+    {
+      return;
+    }
+
+    RaysQuery query;
+    query.setMap(shard.map.get());
+    query.setQueryFlags(query_flags);
+    query.setRays(shard.rays);
+    query.execute();
+    const size_t result_count = std::min(query.numberOfResults(), shard.segments.size());
+    shard.ranges.assign(query.ranges(), query.ranges() + result_count);
+    shard.keys.assign(query.intersectedVoxels(), query.intersectedVoxels() + result_count);
+    shard.types.assign(query.terminalOccupancyTypes(), query.terminalOccupancyTypes() + result_count);
+  });
+
+  // Gather. A ray terminates in the nearest segment which ends at the sample or which stopped short of its end.
+  const size_t ray_count = element_count / 2;
+  const double stop_tolerance = 0.5 * imp_->shards.front().map->resolution();
+  results.clear();
+  results.resize(ray_count);
+  std::vector<double> terminal_range(ray_count, std::numeric_limits<double>::max());
+  for (const auto &shard : imp_->shards)
+  {
+    for (size_t i = 0; i < shard.types.size(); ++i)
+    {
+      const ShardSegment &segment = shard.segments[i];
+      const bool stopped = shard.types[i] == kOccupied || shard.ranges[i] + stop_tolerance < segment.length;
+      const double range = segment.offset + shard.ranges[i];
+      if ((segment.sample_end || stopped) && range < terminal_range[segment.ray_index])
+      {
+        terminal_range[segment.ray_index] = range;
+        ShardedRayResult &result = results[segment.ray_index];
+        result.range = range;
+        result.key = shard.keys[i];
+        result.terminal_type = shard.types[i];
+      }
+    }
+  }
+}
+
+
+size_t ShardedMap::nearestNeighbours(const glm::dvec3 &near_point, float search_radius, std::vector<Key> &keys,
+                                     std::vector<double> &ranges, unsigned query_flags)
+{
+  glm::dvec3 search_min = near_point;
+  glm::dvec3 search_max = near_point;
+  search_min[imp_->axis] -= search_radius;
+  search_max[imp_->axis] += search_radius;
+  const unsigned first_shard = shardIndex(search_min);
+  const unsigned last_shard = shardIndex(search_max);
+
+  std::vector<std::vector<std::pair<double, Key>>> shard_results(imp_->shards.size());
+  forEachShard(*imp_, [&](MapShard &shard) {
+    const auto shard_index = unsigned(&shard - imp_->shards.data());
+    if (shard_index < first_shard || shard_index > last_shard)
+    {
+      return;
+    }
+
+    NearestNeighbours query(*shard.map, near_point, search_radius, query_flags);
+    query.execute();
+    auto &found = shard_results[shard_index];
+    for (size_t i = 0; i < query.numberOfResults(); ++i)
+    {
+      found.emplace_back(query.ranges()[i], query.intersectedVoxels()[i]);
+    }
+  });
+
+  std::vector<std::pair<double, Key>> gathered;
+  for (auto &found : shard_results)
+  {
+    gathered.insert(gathered.end(), found.begin(), found.end());
+  }
+  std::sort(gathered.begin(), gathered.end(),
+            [](const std::pair<double, Key> &a, const std::pair<double, Key> &b) { return a.first < b.first; });
+  if ((query_flags & kQfNearestResult) && gathered.size() > 1)
+  {
+    gathered.resize(1);
+  }
+
+  keys.clear();
+  ranges.clear();
+  for (const auto &entry : gathered)
+  {
+    ranges.emplace_back(entry.first);
+    keys.emplace_back(entry.second);
+  }
+
+  return gathered.size();
+}
+
+
+void ShardedMap::setUseThreads(bool use_threads)
+{
+  imp_->use_threads = use_threads;
+  for (auto &shard : imp_->shards)
+  {
+    shard.mapper->setUseThreads(use_threads);
+  }
+}
+
+
+bool ShardedMap::useThreads() const
+{
+  return imp_->use_threads;
+}
+}  // namespace ohm
@@ -0,0 +1,169 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_SHARDEDMAP_H
+#define OHM_SHARDEDMAP_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "OccupancyType.h"
+#include "QueryFlag.h"
+#include "RayFlag.h"
+
+#include <glm/vec3.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct ShardedMapDetail;
+
+/// Result of a @c ShardedMap::raysQuery() for a single ray. See @c RaysQuery .
+struct ohm_API ShardedRayResult
+{
+  /// Range from the ray origin to the first occupied voxel, or to the end of the ray when there is no occupied voxel.
+  double range = 0;
+  /// The terminating voxel. Null if the ray was filtered.
+  Key key = Key::kNull;
+  /// The occupancy type of the terminating voxel.
+  OccupancyType terminal_type = kNull;
+};
+
+/// An occupancy map partitioned into shards by region key range, with batched updates and queries which are split
+/// across the shards and gathered back in request order.
+///
+/// Each shard is an independent @c OccupancyMap with the same resolution, region dimensions, flags and layout.
+/// Regions are assigned to shards by their region key along the @c axis() using a sorted list of @c boundaries() :
+/// shard @c i owns the regions with keys in the range `[boundaries[i - 1], boundaries[i])` along the axis, with the
+/// first and last shards extending to the limits of the key range. All shards share the same map origin, so voxel
+/// @c Key values are valid across shards.
+///
+/// Batched operations split the request per shard (scatter), run the shards in parallel when built with
+/// @c OHM_FEATURE_THREADS , then merge the results (gather):
+/// - @c integrateRays() clips rays which cross shard boundaries into one segment per shard. Segments other than the
+///   last are integrated with @c kRfEndPointAsFree .
+/// - @c occupancy() looks up each point in the owning shard.
+/// - @c raysQuery() clips rays as for @c integrateRays() , runs a @c RaysQuery per shard and reports the first
+///   occupied voxel along each ray.
+/// - @c nearestNeighbours() runs a @c NearestNeighbours query on each shard overlapping the search volume.
+///
+/// @c setBoundaries() rebalances the shards, moving regions whose owner changes between shards. Regions are moved as
+/// @c MapDelta messages - see @c encodeMapRegions() - the same format used to stream maps between processes, so the
+/// shards are decoupled from each other and only ever exchange serialised regions.
+///
+/// Limitations: @c kRfStopOnFirstOccupied is applied per segment rather than per ray, and @c RaysQuery unobserved
+/// volumes are not reported as they cannot be combined across segments.
+///
+/// Shards may be accessed directly via @c shard() , but regions added to a shard outside its key range are not
+/// found by the batched operations.
+class ohm_API ShardedMap
+{
+public:
+  /// Create a sharded map.
+  ///
+  /// The shard maps are created with the resolution, region dimensions, flags and layout of @p seed_map , which is
+  /// not otherwise used or modified. The default @p boundaries split the region keys evenly around zero, with
+  /// @p regions_per_shard regions per shard, except for the first and last shards.
+  ///
+  /// @param seed_map Map defining the shard configuration.
+  /// @param shard_count Number of shards. Must be at least one.
+  /// @param axis The axis along which regions are partitioned [0, 2].
+  /// @param regions_per_shard Width of each default shard in regions along the @p axis .
+  ShardedMap(const OccupancyMap &seed_map, unsigned shard_count, int axis = 0, int regions_per_shard = 16);
+  /// Destructor.
+  ~ShardedMap();
+
+  /// Query the number of shards.
+  /// @return The shard count.
+  unsigned shardCount() const;
+
+  /// Access a shard map.
+  /// @param index The shard index. Must be less than @c shardCount() .
+  /// @return The shard map.
+  OccupancyMap &shard(unsigned index);
+  /// @overload
+  const OccupancyMap &shard(unsigned index) const;
+
+  /// Query the axis along which regions are partitioned.
+  /// @return The partition axis [0, 2].
+  int axis() const;
+
+  /// Query the shard boundaries. There is one fewer boundary than the @c shardCount() .
+  /// @return The region keys at which each shard after the first starts along the @c axis() .
+  const std::vector<int> &boundaries() const;
+
+  /// Set new shard boundaries, moving regions to their new owning shards.
+  ///
+  /// Must not be called concurrently with other operations.
+  /// @param boundaries The new boundaries. Must be sorted and have one fewer element than the @c shardCount() .
+  /// @return The number of regions moved between shards, or -1 when @p boundaries are invalid or a region fails to
+  ///   transfer.
+  int setBoundaries(const std::vector<int> &boundaries);
+
+  /// Query the shard owning the given region.
+  /// @param region_key The region key.
+  /// @return The owning shard index.
+  unsigned shardIndex(const glm::i16vec3 &region_key) const;
+
+  /// Query the shard owning the region containing @p point .
+  /// @param point The point of interest.
+  /// @return The owning shard index.
+  unsigned shardIndex(const glm::dvec3 &point) const;
+
+  /// Query the total number of regions across all shards.
+  /// @return The region count.
+  size_t regionCount() const;
+
+  /// Integrate a batch of rays into the shards using a @c RayMapperOccupancy per shard.
+  /// @param rays Array of origin/sample point pairs.
+  /// @param element_count The number of points in @p rays . The ray count is half this value.
+  /// @param intensities Optional per ray intensities.
+  /// @param timestamps Optional per ray timestamps.
+  /// @param ray_update_flags @c RayFlag values controlling the update.
+  /// @return The number of ray segments integrated across all shards.
+  size_t integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities = nullptr,
+                       const double *timestamps = nullptr, unsigned ray_update_flags = kRfDefault);
+
+  /// Look up the occupancy value of the voxels containing each of @p points .
+  /// @param points The points to look up.
+  /// @param point_count Number of elements in @p points .
+  /// @param[out] values Set to the occupancy value for each point. Unobserved voxels are set to
+  ///   @c unobservedOccupancyValue() . Must have @p point_count elements.
+  void occupancy(const glm::dvec3 *points, size_t point_count, float *values) const;
+
+  /// Run a @c RaysQuery for a batch of rays across the shards.
+  /// @param rays Array of origin/end point pairs.
+  /// @param element_count The number of points in @p rays . The ray count is half this value.
+  /// @param[out] results Set to one result per ray.
+  /// @param query_flags @c QueryFlag values for the query.
+  void raysQuery(const glm::dvec3 *rays, size_t element_count, std::vector<ShardedRayResult> &results,
+                 unsigned query_flags = kQfDefaultFlags);
+
+  /// Run a @c NearestNeighbours query across the shards overlapping the search volume.
+  /// @param near_point The search centre.
+  /// @param search_radius The search radius.
+  /// @param[out] keys Set to the keys of the voxels found, ordered by range.
+  /// @param[out] ranges Set to the range to each voxel in @p keys .
+  /// @param query_flags @c QueryFlag values for the query.
+  /// @return The number of voxels found.
+  size_t nearestNeighbours(const glm::dvec3 &near_point, float search_radius, std::vector<Key> &keys,
+                           std::vector<double> &ranges, unsigned query_flags = kQfDefaultFlags);
+
+  /// Enable or disable running the shards in parallel.
+  /// @param use_threads True to use threads when available.
+  void setUseThreads(bool use_threads);
+  /// Query whether the shards run in parallel.
+  /// @return True when using threads.
+  bool useThreads() const;
+
+private:
+  std::unique_ptr<ShardedMapDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_SHARDEDMAP_H
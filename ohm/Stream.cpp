@@ -5,12 +5,14 @@
 // Author: Kazys Stepanas
 #include "Stream.h"
 
+#include "private/AsyncFile.h"
+
 #ifdef OHM_ZIP
 #include <zlib.h>
 #endif  // OHM_ZIP
 
+#include <algorithm>
 #include <cstring>
-#include <fstream>
 #include <string>
 
 namespace ohm
@@ -101,17 +103,47 @@ struct StreamPrivate
   unsigned flags = 0;
 };
 
+/// Input streams read ahead, keeping reads in flight for all @c AsyncFile buffers at successive file offsets. Buffers
+/// are consumed in order from the @c head buffer.
 struct InputStreamPrivate : StreamPrivate
 {
-  std::ifstream in;
+  AsyncFile file;
+  /// File size on opening.
+  uint64_t file_size = 0;
+  /// Logical read position: the file offset of the next byte returned by @c readRaw() .
+  uint64_t position = 0;
+  /// File offset for the next read ahead.
+  uint64_t read_ahead_offset = 0;
+  /// Index of the buffer currently being consumed.
+  unsigned head = 0;
+  /// Number of buffers with reads submitted, including the @c head .
+  unsigned queued = 0;
+  /// Number of valid bytes in the @c head buffer once its read has completed.
+  size_t head_size = 0;
+  /// Number of bytes consumed from the @c head buffer.
+  size_t head_consumed = 0;
+  /// True once the read for the @c head buffer has completed.
+  bool head_ready = false;
+  /// Set on a read failure.
+  bool failed = false;
 #ifdef OHM_ZIP
   Compression compress;
 #endif  // OHM_ZIP
 };
 
+/// Output streams write behind: data are staged in the @c current @c AsyncFile buffer, which is submitted once full
+/// while the next buffer is filled.
 struct OutputStreamPrivate : StreamPrivate
 {
-  std::ofstream out;
+  AsyncFile file;
+  /// File offset at which the @c current buffer is written.
+  uint64_t position = 0;
+  /// Index of the buffer being staged.
+  unsigned current = 0;
+  /// Number of bytes staged in the @c current buffer.
+  size_t staged = 0;
+  /// Set on a write failure.
+  bool failed = false;
 #ifdef OHM_ZIP
   Compression compress;
   bool needs_flush = false;
@@ -119,6 +151,130 @@ struct OutputStreamPrivate : StreamPrivate
 };
 
 
+namespace
+{
+/// Submit the read ahead for all idle buffers.
+void readAhead(InputStreamPrivate &imp)
+{
+  const unsigned buffer_count = imp.file.bufferCount();
+  while (imp.queued < buffer_count && imp.read_ahead_offset < imp.file_size)
+  {
+    const unsigned index = (imp.head + imp.queued) % buffer_count;
+    const auto byte_count = size_t(std::min<uint64_t>(imp.file.bufferSize(), imp.file_size - imp.read_ahead_offset));
+    if (!imp.file.submitRead(index, byte_count, imp.read_ahead_offset))
+    {
+      break;
+    }
+    imp.read_ahead_offset += byte_count;
+    ++imp.queued;
+  }
+}
+
+
+/// Discard any read ahead and restart reading at @p position .
+void resetReadAhead(InputStreamPrivate &imp, uint64_t position)
+{
+  imp.file.waitAll();
+  imp.position = imp.read_ahead_offset = position;
+  imp.head = imp.queued = 0;
+  imp.head_size = imp.head_consumed = 0;
+  imp.head_ready = false;
+  imp.failed = false;
+}
+
+
+/// Read up to @p byte_count bytes from the read ahead buffers.
+/// @return The number of bytes read.
+size_t readBuffered(InputStreamPrivate &imp, uint8_t *data, size_t byte_count)
+{
+  size_t read = 0;
+  while (read < byte_count && !imp.failed)
+  {
+    if (imp.head_consumed == imp.head_size)
+    {
+      if (imp.head_ready)
+      {
+        // Head consumed. Release it to the read ahead.
+        imp.head = (imp.head + 1) % imp.file.bufferCount();
+        --imp.queued;
+        imp.head_size = imp.head_consumed = 0;
+        imp.head_ready = false;
+      }
+
+      readAhead(imp);
+      if (imp.queued == 0)
+      {
+        // End of file.
+        break;
+      }
+
+      const std::ptrdiff_t result = imp.file.wait(imp.head);
+      if (result <= 0)
+      {
+        imp.failed = true;
+        break;
+      }
+      imp.head_size = size_t(result);
+      imp.head_ready = true;
+    }
+
+    const size_t copy_count = std::min(byte_count - read, imp.head_size - imp.head_consumed);
+    std::memcpy(data + read, imp.file.buffer(imp.head) + imp.head_consumed, copy_count);
+    imp.head_consumed += copy_count;
+    read += copy_count;
+  }
+  imp.position += read;
+  return read;
+}
+
+
+/// Submit the @c current buffer for writing, if anything is staged, and move to the next buffer.
+void submitStaged(OutputStreamPrivate &imp)
+{
+  if (imp.staged == 0)
+  {
+    return;
+  }
+
+  if (!imp.file.submitWrite(imp.current, imp.staged, imp.position))
+  {
+    imp.failed = true;
+  }
+  imp.position += imp.staged;
+  imp.staged = 0;
+  imp.current = (imp.current + 1) % imp.file.bufferCount();
+}
+
+
+/// Stage @p byte_count bytes for writing, submitting each buffer once full.
+/// @return False on failure, which may be from a previously submitted write.
+bool writeBuffered(OutputStreamPrivate &imp, const uint8_t *data, size_t byte_count)
+{
+  while (byte_count && !imp.failed)
+  {
+    if (imp.staged == 0 && imp.file.wait(imp.current) < 0)
+    {
+      // The previous write from this buffer failed.
+      imp.failed = true;
+      break;
+    }
+
+    const size_t copy_count = std::min(byte_count, imp.file.bufferSize() - imp.staged);
+    std::memcpy(imp.file.buffer(imp.current) + imp.staged, data, copy_count);
+    imp.staged += copy_count;
+    data += copy_count;
+    byte_count -= copy_count;
+
+    if (imp.staged == imp.file.bufferSize())
+    {
+      submitStaged(imp);
+    }
+  }
+  return !imp.failed;
+}
+}  // namespace
+
+
 const std::string &Stream::filePath() const
 {
   return imp_->file_path;
@@ -253,18 +409,13 @@ unsigned InputStream::read(void *buffer, unsigned max_bytes)
 
 unsigned InputStream::readRaw(void *buffer, unsigned max_bytes)
 {
-  std::istream &in = imp()->in;
-  const std::ifstream::pos_type initial_pos = in.tellg();
-  in.read(static_cast<char *>(buffer), max_bytes);
-  const std::ifstream::pos_type end_pos = in.tellg();
-  auto read = unsigned(end_pos - initial_pos);
-  return read;
+  return unsigned(readBuffered(*imp(), static_cast<uint8_t *>(buffer), max_bytes));
 }
 
 
 bool InputStream::isOpen() const
 {
-  return imp()->in.is_open();
+  return imp()->file.isOpen();
 }
 
 
@@ -274,7 +425,9 @@ void InputStream::flush()
 
 bool InputStream::doOpen(const std::string &file_path, unsigned flags)
 {
-  imp()->in.open(file_path.c_str(), std::ios_base::binary);
+  imp()->file.open(file_path, kAfRead);
+  imp()->file_size = imp()->file.fileSize();
+  resetReadAhead(*imp(), 0);
   imp()->file_path = file_path;
 #ifndef OHM_ZIP
   flags &= ~SF_Compress;
@@ -286,7 +439,7 @@ bool InputStream::doOpen(const std::string &file_path, unsigned flags)
     imp()->compress.initInflate();
   }
 #endif  // OHM_ZIP
-  return imp()->in.is_open();
+  return imp()->file.isOpen();
 }
 
 
@@ -298,7 +451,7 @@ void InputStream::doClose()
     imp()->compress.doneInflate();
   }
 #endif  // OHM_ZIP
-  imp()->in.close();
+  imp()->file.close();
   imp_->flags = 0;
   imp_->file_path = std::string();
 }
@@ -306,13 +459,13 @@ void InputStream::doClose()
 
 void InputStream::doSeek(size_t pos)
 {
-  imp()->in.seekg(pos, std::ios_base::beg);
+  resetReadAhead(*imp(), pos);
 }
 
 
 size_t InputStream::doTell()
 {
-  return imp()->in.tellg();
+  return size_t(imp()->position);
 }
 
 
@@ -377,8 +530,10 @@ unsigned OutputStream::write(const void *buffer, unsigned max_bytes)
 
       if (imp.compress.stream.avail_out == 0)
       {
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-        imp.out.write(reinterpret_cast<char *>(imp.compress.buffer), imp.compress.buffer_size);
+        if (!writeBuffered(imp, imp.compress.buffer, imp.compress.buffer_size))
+        {
+          return ~unsigned(0u);
+        }
         imp.compress.stream.avail_out = imp.compress.buffer_size;
         imp.compress.stream.next_out = imp.compress.buffer;
       }
@@ -393,8 +548,7 @@ unsigned OutputStream::write(const void *buffer, unsigned max_bytes)
 
 unsigned OutputStream::writeUncompressed(const void *buffer, unsigned max_bytes)
 {
-  imp()->out.write(static_cast<const char *>(buffer), max_bytes);
-  if (imp()->out.good())
+  if (writeBuffered(*imp(), static_cast<const uint8_t *>(buffer), max_bytes))
   {
     return max_bytes;
   }
@@ -405,7 +559,7 @@ unsigned OutputStream::writeUncompressed(const void *buffer, unsigned max_bytes)
 
 bool OutputStream::isOpen() const
 {
-  return imp()->out.is_open();
+  return imp()->file.isOpen();
 }
 
 
@@ -425,8 +579,7 @@ void OutputStream::flush()
       unsigned have = imp.compress.buffer_size - imp.compress.stream.avail_out;
       if (have)
       {
-        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-        imp.out.write(reinterpret_cast<char *>(imp.compress.buffer), have);
+        writeBuffered(imp, imp.compress.buffer, have);
       }
 
       imp.compress.stream.avail_out = imp.compress.buffer_size;
@@ -436,25 +589,35 @@ void OutputStream::flush()
     imp.needs_flush = false;
   }
 #endif  // OHM_ZIP
-  imp.out.flush();
+  // Complete all writes.
+  submitStaged(imp);
+  if (!imp.file.waitAll())
+  {
+    imp.failed = true;
+  }
 }
 
 
 bool OutputStream::doOpen(const std::string &file_path, unsigned flags)
 {
-  imp()->out.open(file_path.c_str(), std::ios_base::binary);
-  imp()->file_path = file_path;
+  OutputStreamPrivate &imp = *this->imp();
+  imp.file.open(file_path, (flags & kSfAppend) ? kAfWrite : kAfWrite | kAfTruncate);
+  imp.position = (flags & kSfAppend) ? imp.file.fileSize() : 0u;
+  imp.current = 0;
+  imp.staged = 0;
+  imp.failed = false;
+  imp.file_path = file_path;
 #ifndef OHM_ZIP
   flags &= ~SF_Compress;
 #endif  // OHM_ZIP
-  imp()->flags = flags;
+  imp.flags = flags;
 #ifdef OHM_ZIP
   if (flags & kSfCompress)
   {
-    imp()->compress.initDeflate();
+    imp.compress.initDeflate();
   }
 #endif  // OHM_ZIP
-  return imp()->out.is_open();
+  return imp.file.isOpen();
 }
 
 
@@ -466,7 +629,7 @@ void OutputStream::doClose()
     imp()->compress.doneDeflate();
   }
 #endif  // OHM_ZIP
-  imp()->out.close();
+  imp()->file.close();
   imp_->flags = 0;
   imp_->file_path = std::string();
 }
@@ -474,13 +637,14 @@ void OutputStream::doClose()
 
 void OutputStream::doSeek(size_t pos)
 {
-  imp()->out.seekp(pos, std::ios_base::beg);
+  // Staged data have been flushed by seek().
+  imp()->position = pos;
 }
 
 
 size_t OutputStream::doTell()
 {
-  return imp()->out.tellp();
+  return size_t(imp()->position + imp()->staged);
 }
 
 
@@ -25,6 +25,8 @@ enum StreamFlag : unsigned
 {
   /// Compression is enabled.
   kSfCompress = (1u << 0u),
+  /// Open an @c OutputStream to append to an existing file rather than truncating it.
+  kSfAppend = (1u << 1u),
 };
 
 
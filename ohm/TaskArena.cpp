@@ -0,0 +1,59 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "TaskArena.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace ohm
+{
+#ifdef OHM_FEATURE_THREADS
+namespace
+{
+/// The installed arena. Accessed via the @c std::atomic_load() / @c std::atomic_store() @c shared_ptr overloads.
+std::shared_ptr<tbb::task_arena> s_arena;
+}  // namespace
+
+
+void setTaskArena(std::shared_ptr<tbb::task_arena> arena)
+{
+  std::atomic_store(&s_arena, std::move(arena));
+}
+
+
+std::shared_ptr<tbb::task_arena> taskArena()
+{
+  return std::atomic_load(&s_arena);
+}
+#endif  // OHM_FEATURE_THREADS
+
+
+void setParallelConcurrency(unsigned max_concurrency)
+{
+#ifdef OHM_FEATURE_THREADS
+  setTaskArena((max_concurrency) ? std::make_shared<tbb::task_arena>(int(max_concurrency)) : nullptr);
+#else   // OHM_FEATURE_THREADS
+  (void)max_concurrency;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+unsigned parallelConcurrency()
+{
+#ifdef OHM_FEATURE_THREADS
+  const std::shared_ptr<tbb::task_arena> arena = taskArena();
+  if (arena)
+  {
+    // Initialise so max_concurrency() reports the actual concurrency, rather than automatic.
+    arena->initialize();
+    return unsigned(std::max(1, arena->max_concurrency()));
+  }
+  return unsigned(std::max(1, tbb::this_task_arena::max_concurrency()));
+#else   // OHM_FEATURE_THREADS
+  return 1u;
+#endif  // OHM_FEATURE_THREADS
+}
+}  // namespace ohm
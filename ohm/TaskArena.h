@@ -0,0 +1,84 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_TASKARENA_H
+#define OHM_TASKARENA_H
+
+#include "OhmConfig.h"
+
+#include <memory>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/task_arena.h>
+#endif  // OHM_FEATURE_THREADS
+
+namespace ohm
+{
+/// @defgroup taskarena Task arena
+/// Library wide control of the threads used by ohm parallel operations.
+///
+/// By default ohm parallel operations - ray integration, queries, heightmap generation, map comparison and
+/// serialisation - run on the global TBB scheduler and may use every core. A host process may instead install a
+/// @c tbb::task_arena , either its own via @c setTaskArena() or one created by @c setParallelConcurrency() , to
+/// partition CPU time between ohm and other work. All ohm parallel operations then execute within that arena via
+/// @c parallelExecute() .
+///
+/// Objects with an explicit thread count, such as @c Mapper::setThreadCount() and @c Heightmap::setThreadCount() ,
+/// continue to use their own arena of that size. Background threads, such as the @c VoxelBlockCompressionQueue , are
+/// not affected.
+///
+/// Without @c OHM_FEATURE_THREADS all operations are serial and these functions have no effect.
+/// @{
+
+#ifdef OHM_FEATURE_THREADS
+/// Install the task arena used by all ohm parallel operations. This replaces any existing arena.
+///
+/// Operations already in progress complete in the arena they started in. The @p arena is shared so that it remains
+/// valid until such operations complete.
+///
+/// @param arena The arena to use. Null restores the global TBB scheduler.
+void ohm_API setTaskArena(std::shared_ptr<tbb::task_arena> arena);
+
+/// Query the task arena installed by @c setTaskArena() or @c setParallelConcurrency() .
+/// @return The current arena or null when using the global TBB scheduler.
+std::shared_ptr<tbb::task_arena> ohm_API taskArena();
+#endif  // OHM_FEATURE_THREADS
+
+/// Limit the number of threads used by ohm parallel operations by installing a new task arena with
+/// @p max_concurrency slots - see @c setTaskArena() .
+///
+/// @param max_concurrency The maximum number of concurrent threads, including the calling thread. Zero restores the
+///   global TBB scheduler.
+void ohm_API setParallelConcurrency(unsigned max_concurrency);
+
+/// Query the maximum number of threads which may be used by ohm parallel operations.
+/// @return The concurrency of the installed arena or of the global TBB scheduler. Always 1 without
+///   @c OHM_FEATURE_THREADS .
+unsigned ohm_API parallelConcurrency();
+
+/// Invoke @p func within the installed @c taskArena() , or directly when there is no arena or no thread support.
+///
+/// All parallel algorithms in @p func then run in the installed arena. This is cheap when already executing in that
+/// arena, so nested calls are fine.
+///
+/// @param func The function to invoke: `void()` .
+template <typename Func>
+inline void parallelExecute(Func &&func)
+{
+#ifdef OHM_FEATURE_THREADS
+  const std::shared_ptr<tbb::task_arena> arena = taskArena();
+  if (arena)
+  {
+    arena->execute(func);
+    return;
+  }
+#endif  // OHM_FEATURE_THREADS
+  func();
+}
+
+/// @}
+}  // namespace ohm
+
+#endif  // OHM_TASKARENA_H
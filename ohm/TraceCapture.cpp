@@ -0,0 +1,317 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "TraceCapture.h"
+
+#include "OccupancyMap.h"
+
+#include "private/TraceCaptureDetail.h"
+
+#include <cstring>
+
+namespace ohm
+{
+namespace
+{
+/// Marker bytes identifying a trace capture.
+const uint32_t kTraceCaptureMarker = 0x54524333u;
+/// Marker bytes starting each batch.
+const uint32_t kBatchMarker = 0x42415443u;
+/// Current capture format version.
+const uint16_t kVersionMajor = 0;
+const uint16_t kVersionMinor = 1;
+/// Header flag set when batches include rays.
+const uint32_t kFlagWithRays = 1u;
+/// Serialised byte size of one @c TraceCaptureVoxel .
+const size_t kVoxelByteSize = 3 * sizeof(int16_t) + 3 * sizeof(uint8_t) + 2 * sizeof(uint8_t) + sizeof(float);
+
+/// Append a typed value to @p buffer .
+template <typename T, typename S>
+inline void appendValue(std::vector<uint8_t> &buffer, const S &val)
+{
+  const T val2 = static_cast<T>(val);
+  const size_t offset = buffer.size();
+  buffer.resize(offset + sizeof(val2));
+  memcpy(buffer.data() + offset, &val2, sizeof(val2));
+}
+
+/// Read a typed value from @p in . Returns false on failure.
+template <typename T, typename S>
+inline bool readValue(std::istream &in, S &val)
+{
+  T val2;
+  if (!in.read(reinterpret_cast<char *>(&val2), sizeof(val2)))
+  {
+    return false;
+  }
+  val = static_cast<S>(val2);
+  return true;
+}
+
+/// Read a typed value from @p cursor , advancing the cursor. The caller ensures enough bytes remain.
+template <typename T, typename S>
+inline void readValue(const uint8_t *&cursor, S &val)
+{
+  T val2;
+  memcpy(&val2, cursor, sizeof(val2));
+  cursor += sizeof(val2);
+  val = static_cast<S>(val2);
+}
+
+void writerThread(TraceCaptureWriterDetail &imp)
+{
+  std::unique_lock<std::mutex> guard(imp.queue_lock);
+  while (true)
+  {
+    imp.queue_notify.wait(guard, [&imp]() { return !imp.queue.empty() || imp.quit_flag; });
+    if (imp.queue.empty())
+    {
+      // Quit with nothing left to write.
+      break;
+    }
+
+    std::vector<uint8_t> batch = std::move(imp.queue.front());
+    imp.queue.pop_front();
+    // Write without holding the lock so the mapping thread does not block on file IO.
+    guard.unlock();
+    if (!imp.out.write(reinterpret_cast<const char *>(batch.data()), std::streamsize(batch.size())))
+    {
+      imp.failed = true;
+    }
+    guard.lock();
+  }
+}
+}  // namespace
+
+
+TraceCaptureWriter::TraceCaptureWriter()
+  : imp_(std::make_unique<TraceCaptureWriterDetail>())
+{}
+
+
+TraceCaptureWriter::~TraceCaptureWriter()
+{
+  close();
+}
+
+
+bool TraceCaptureWriter::open(const std::string &filename, const OccupancyMap &map, bool with_rays)
+{
+  close();
+
+  imp_->out.open(filename, std::ios::binary | std::ios::trunc);
+  if (!imp_->out.is_open())
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> header;
+  appendValue<uint32_t>(header, kTraceCaptureMarker);
+  appendValue<uint16_t>(header, kVersionMajor);
+  appendValue<uint16_t>(header, kVersionMinor);
+  appendValue<double>(header, map.origin().x);
+  appendValue<double>(header, map.origin().y);
+  appendValue<double>(header, map.origin().z);
+  appendValue<double>(header, map.resolution());
+  appendValue<int32_t>(header, map.regionVoxelDimensions().x);
+  appendValue<int32_t>(header, map.regionVoxelDimensions().y);
+  appendValue<int32_t>(header, map.regionVoxelDimensions().z);
+  appendValue<uint32_t>(header, (with_rays) ? kFlagWithRays : 0u);
+
+  if (!imp_->out.write(reinterpret_cast<const char *>(header.data()), std::streamsize(header.size())))
+  {
+    imp_->out.close();
+    return false;
+  }
+
+  imp_->with_rays = with_rays;
+  imp_->failed = false;
+  imp_->quit_flag = false;
+  TraceCaptureWriterDetail *imp = imp_.get();
+  imp_->writer_thread = std::thread([imp]() { writerThread(*imp); });
+  return true;
+}
+
+
+void TraceCaptureWriter::close()
+{
+  if (imp_->writer_thread.joinable())
+  {
+    {
+      std::unique_lock<std::mutex> guard(imp_->queue_lock);
+      imp_->quit_flag = true;
+    }
+    imp_->queue_notify.notify_one();
+    imp_->writer_thread.join();
+  }
+
+  if (imp_->out.is_open())
+  {
+    imp_->out.close();
+  }
+}
+
+
+bool TraceCaptureWriter::isOpen() const
+{
+  return imp_->writer_thread.joinable();
+}
+
+
+bool TraceCaptureWriter::failed() const
+{
+  return imp_->failed;
+}
+
+
+void TraceCaptureWriter::push(uint64_t batch_index, const glm::dvec3 *rays, size_t element_count,
+                              const std::vector<TraceCaptureVoxel> &voxels)
+{
+  if (!isOpen())
+  {
+    return;
+  }
+
+  const size_t ray_count = (imp_->with_rays && rays) ? element_count / 2 : 0u;
+  std::vector<uint8_t> batch;
+  batch.reserve(sizeof(uint32_t) * 3 + sizeof(uint64_t) + ray_count * 2 * sizeof(glm::dvec3) +
+                voxels.size() * kVoxelByteSize);
+
+  appendValue<uint32_t>(batch, kBatchMarker);
+  appendValue<uint64_t>(batch, batch_index);
+  appendValue<uint32_t>(batch, ray_count);
+  if (ray_count)
+  {
+    const size_t offset = batch.size();
+    batch.resize(offset + ray_count * 2 * sizeof(glm::dvec3));
+    memcpy(batch.data() + offset, rays, ray_count * 2 * sizeof(glm::dvec3));
+  }
+
+  appendValue<uint32_t>(batch, voxels.size());
+  for (const TraceCaptureVoxel &voxel : voxels)
+  {
+    const glm::i16vec3 region = voxel.key.regionKey();
+    const glm::u8vec3 local = voxel.key.localKey();
+    appendValue<int16_t>(batch, region.x);
+    appendValue<int16_t>(batch, region.y);
+    appendValue<int16_t>(batch, region.z);
+    appendValue<uint8_t>(batch, local.x);
+    appendValue<uint8_t>(batch, local.y);
+    appendValue<uint8_t>(batch, local.z);
+    appendValue<uint8_t>(batch, voxel.initial_type - kNull);
+    appendValue<uint8_t>(batch, voxel.type - kNull);
+    appendValue<float>(batch, voxel.occupancy);
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(imp_->queue_lock);
+    imp_->queue.emplace_back(std::move(batch));
+  }
+  imp_->queue_notify.notify_one();
+}
+
+
+bool TraceCaptureReader::read(const std::string &filename, const BatchFunction &batch_func, TraceCaptureInfo *info)
+{
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.is_open())
+  {
+    return false;
+  }
+
+  uint32_t marker = 0;
+  uint16_t version_major = 0;
+  uint16_t version_minor = 0;
+  TraceCaptureInfo header;
+  uint32_t flags = 0;
+  bool ok = true;
+  ok = readValue<uint32_t>(in, marker) && ok;
+  ok = readValue<uint16_t>(in, version_major) && ok;
+  ok = readValue<uint16_t>(in, version_minor) && ok;
+  if (!ok || marker != kTraceCaptureMarker || version_major != kVersionMajor || version_minor > kVersionMinor)
+  {
+    return false;
+  }
+
+  ok = readValue<double>(in, header.origin.x) && ok;
+  ok = readValue<double>(in, header.origin.y) && ok;
+  ok = readValue<double>(in, header.origin.z) && ok;
+  ok = readValue<double>(in, header.resolution) && ok;
+  ok = readValue<int32_t>(in, header.region_voxel_dimensions.x) && ok;
+  ok = readValue<int32_t>(in, header.region_voxel_dimensions.y) && ok;
+  ok = readValue<int32_t>(in, header.region_voxel_dimensions.z) && ok;
+  ok = readValue<uint32_t>(in, flags) && ok;
+  if (!ok)
+  {
+    return false;
+  }
+  header.with_rays = (flags & kFlagWithRays) != 0;
+
+  if (info)
+  {
+    *info = header;
+  }
+
+  TraceCaptureBatch batch;
+  std::vector<uint8_t> voxel_bytes;
+  while (readValue<uint32_t>(in, marker))
+  {
+    uint32_t ray_count = 0;
+    uint32_t voxel_count = 0;
+    if (marker != kBatchMarker || !readValue<uint64_t>(in, batch.batch_index) || !readValue<uint32_t>(in, ray_count))
+    {
+      // Truncated or corrupt batch.
+      return marker == kBatchMarker;
+    }
+
+    batch.rays.resize(size_t(ray_count) * 2);
+    if (ray_count && !in.read(reinterpret_cast<char *>(batch.rays.data()),
+                              std::streamsize(batch.rays.size() * sizeof(glm::dvec3))))
+    {
+      return true;
+    }
+
+    if (!readValue<uint32_t>(in, voxel_count))
+    {
+      return true;
+    }
+
+    voxel_bytes.resize(voxel_count * kVoxelByteSize);
+    if (voxel_count && !in.read(reinterpret_cast<char *>(voxel_bytes.data()), std::streamsize(voxel_bytes.size())))
+    {
+      return true;
+    }
+
+    batch.voxels.resize(voxel_count);
+    const uint8_t *cursor = voxel_bytes.data();
+    for (TraceCaptureVoxel &voxel : batch.voxels)
+    {
+      glm::i16vec3 region;
+      glm::u8vec3 local;
+      int initial_type = 0;
+      int type = 0;
+      readValue<int16_t>(cursor, region.x);
+      readValue<int16_t>(cursor, region.y);
+      readValue<int16_t>(cursor, region.z);
+      readValue<uint8_t>(cursor, local.x);
+      readValue<uint8_t>(cursor, local.y);
+      readValue<uint8_t>(cursor, local.z);
+      readValue<uint8_t>(cursor, initial_type);
+      readValue<uint8_t>(cursor, type);
+      readValue<float>(cursor, voxel.occupancy);
+      voxel.key = Key(region, local);
+      voxel.initial_type = OccupancyType(initial_type + kNull);
+      voxel.type = OccupancyType(type + kNull);
+    }
+
+    if (!batch_func(batch))
+    {
+      break;
+    }
+  }
+
+  return true;
+}
+}  // namespace ohm
@@ -0,0 +1,131 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_TRACECAPTURE_H
+#define OHM_TRACECAPTURE_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "OccupancyType.h"
+
+#include <glm/vec3.hpp>
+
+#include <cinttypes>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+struct TraceCaptureWriterDetail;
+
+/// Voxel change recorded in a trace capture.
+struct ohm_API TraceCaptureVoxel
+{
+  Key key = Key::kNull;                ///< The voxel key.
+  float occupancy = 0;                 ///< The occupancy value after the batch.
+  OccupancyType initial_type = kNull;  ///< The voxel type before the batch.
+  OccupancyType type = kNull;          ///< The voxel type after the batch.
+};
+
+/// A single batch recorded in a trace capture by @c RayMapperTrace .
+struct ohm_API TraceCaptureBatch
+{
+  /// The @c RayMapperTrace batch number - the number of @c RayMapper::integrateRays() calls before this one.
+  uint64_t batch_index = 0;
+  /// The traced rays as origin/sample pairs. Empty unless the capture was written with rays.
+  std::vector<glm::dvec3> rays;
+  /// Voxels which changed in the batch.
+  std::vector<TraceCaptureVoxel> voxels;
+};
+
+/// Map information recorded at the start of a trace capture.
+struct ohm_API TraceCaptureInfo
+{
+  glm::dvec3 origin{ 0 };                   ///< Map origin.
+  double resolution = 0;                    ///< Map voxel resolution.
+  glm::ivec3 region_voxel_dimensions{ 0 };  ///< Map region voxel dimensions.
+  bool with_rays = false;                   ///< True if the batches include rays.
+};
+
+/// Writes a compact, binary trace capture for @c RayMapperTrace from a background thread.
+///
+/// A capture records the voxels changed by each traced batch rather than emitting 3rd Eye Scene shapes while mapping.
+/// Captures may be converted offline using a @c TraceCaptureReader . The format is:
+/// - Header:
+///   - @c uint32_t capture marker
+///   - @c uint16_t major, @c uint16_t minor version numbers
+///   - @c double map origin x, y, z then @c double map resolution
+///   - @c int32_t region voxel dimensions x, y, z
+///   - @c uint32_t flags : bit 0 is set when batches include rays
+/// - Batches:
+///   - @c uint32_t batch marker
+///   - @c uint64_t batch index
+///   - @c uint32_t ray count then, with rays, @c double origin and sample x, y, z for each ray
+///   - @c uint32_t voxel count then for each voxel: @c int16_t region key x, y, z, @c uint8_t local key x, y, z,
+///     @c uint8_t initial and final @c OccupancyType (offset by two so @c kNull is zero) and @c float occupancy
+///
+/// @c push() serialises the batch on the calling thread, which is a few bytes per changed voxel, and queues it for
+/// the writer thread.
+class ohm_API TraceCaptureWriter
+{
+public:
+  /// Constructor. The capture is not open.
+  TraceCaptureWriter();
+  /// Destructor - calls @c close() .
+  ~TraceCaptureWriter();
+
+  /// Open a capture file at @p filename for @p map and start the writer thread. Closes any open capture first.
+  /// @param filename The capture file path.
+  /// @param map The map being traced. Only used to write the header.
+  /// @param with_rays Record the rays of each batch as well as the voxel changes?
+  /// @return True on successfully opening the file.
+  bool open(const std::string &filename, const OccupancyMap &map, bool with_rays);
+
+  /// Flush all queued batches, close the file and stop the writer thread.
+  void close();
+
+  /// Query if a capture is open.
+  /// @return True when open.
+  bool isOpen() const;
+
+  /// Query if an error has occurred writing the capture.
+  /// @return True if a write has failed.
+  bool failed() const;
+
+  /// Queue a batch for writing. Ignored when not open.
+  /// @param batch_index The batch number.
+  /// @param rays The batch origin/sample pairs. Only written when opened @c with_rays .
+  /// @param element_count Number of elements in @p rays - twice the ray count.
+  /// @param voxels The changed voxels.
+  void push(uint64_t batch_index, const glm::dvec3 *rays, size_t element_count,
+            const std::vector<TraceCaptureVoxel> &voxels);
+
+private:
+  std::unique_ptr<TraceCaptureWriterDetail> imp_;
+};
+
+/// Reads a capture written by a @c TraceCaptureWriter .
+class ohm_API TraceCaptureReader
+{
+public:
+  /// Callback invoked for each batch read. Return false to stop reading.
+  using BatchFunction = std::function<bool(const TraceCaptureBatch &)>;
+
+  /// Read the capture at @p filename , invoking @p batch_func for each batch in order.
+  ///
+  /// A capture truncated by an interrupted write is read up to the last complete batch.
+  /// @param filename The capture file path.
+  /// @param batch_func Batch callback.
+  /// @param[out] info Optional capture header information.
+  /// @return True if the header was valid and all complete batches were read.
+  static bool read(const std::string &filename, const BatchFunction &batch_func, TraceCaptureInfo *info = nullptr);
+};
+}  // namespace ohm
+
+#endif  // OHM_TRACECAPTURE_H
@@ -0,0 +1,315 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "TransformSamplesCpu.h"
+
+#include "TaskArena.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace ohm
+{
+namespace
+{
+/// Number of samples per independently processed chunk.
+constexpr size_t kSamplesPerChunk = 4096u;
+
+/// Precalculated interpolation parameters for the trajectory segment between two transforms.
+struct TrajectorySegment
+{
+  glm::dvec3 from_position{ 0 };
+  glm::dvec3 delta_position{ 0 };
+  glm::dquat from_rotation{ 1, 0, 0, 0 };
+  /// The end rotation, negated if required to interpolate along the shortest path.
+  glm::dquat to_rotation{ 1, 0, 0, 0 };
+  double start_time = 0;
+  double inv_duration = 0;
+  /// Angle between the rotations. Zero selects linear interpolation.
+  double angle = 0;
+  double inv_sin_angle = 0;
+};
+
+
+std::vector<TrajectorySegment> buildSegments(const double *times, const glm::dvec3 *translations,
+                                             const glm::dquat *rotations, unsigned count)
+{
+  // Use one segment with matching ends for a single transform.
+  const unsigned segment_count = std::max(1u, count - 1);
+  std::vector<TrajectorySegment> segments(segment_count);
+  for (unsigned i = 0; i < segment_count; ++i)
+  {
+    const unsigned to = std::min(i + 1, count - 1);
+    TrajectorySegment &segment = segments[i];
+    segment.from_position = translations[i];
+    segment.delta_position = translations[to] - translations[i];
+    segment.from_rotation = rotations[i];
+    segment.start_time = times[i];
+    const double duration = times[to] - times[i];
+    segment.inv_duration = (duration > 0) ? 1.0 / duration : 0.0;
+
+    double cos_angle = glm::dot(rotations[i], rotations[to]);
+    segment.to_rotation = (cos_angle >= 0) ? rotations[to] : -rotations[to];
+    cos_angle = std::abs(cos_angle);
+    // Numerical round off could create problems in acos(). Use linear interpolation for near identical rotations.
+    if (1.0 - cos_angle > 1e-12)  // NOLINT(readability-magic-numbers)
+    {
+      segment.angle = std::acos(cos_angle);
+      segment.inv_sin_angle = 1.0 / std::sin(segment.angle);
+    }
+  }
+  return segments;
+}
+
+
+/// Find the segment index for @p time , starting from the @p hint segment, which is normally correct for sorted
+/// sample times.
+inline unsigned findSegment(const double *times, unsigned transform_count, double time, unsigned hint)
+{
+  if (transform_count < 3)
+  {
+    return 0;
+  }
+
+  const unsigned last_segment = transform_count - 2;
+  if (times[hint] <= time && (hint == last_segment || time < times[hint + 1]))
+  {
+    return hint;
+  }
+
+  // Locate the first transform after time and step back one. Clamp for times outside the trajectory.
+  const double *after = std::upper_bound(times, times + transform_count, time);
+  const auto index = unsigned(std::max<std::ptrdiff_t>(after - times - 1, 0));
+  return std::min(index, last_segment);
+}
+
+
+inline bool goodSample(const glm::dvec3 &sample, double max_range_sqr)
+{
+  if (glm::any(glm::isnan(sample)) || glm::any(glm::isinf(sample)))
+  {
+    return false;
+  }
+
+  return glm::dot(sample, sample) <= max_range_sqr;
+}
+
+
+/// Invoke @p func for each index in [0, count), splitting across threads when @p use_threads is set.
+void parallelFor(size_t count, bool use_threads, const std::function<void(size_t, size_t)> &func)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, count),
+                        [&func](const tbb::blocked_range<size_t> &range) { func(range.begin(), range.end()); });
+    });
+    return;
+  }
+#else   // OHM_FEATURE_THREADS
+  (void)use_threads;
+#endif  // OHM_FEATURE_THREADS
+  func(0, count);
+}
+
+/// Reads double precision, array of structures samples.
+struct VectorSamples
+{
+  const double *times;
+  const glm::dvec3 *samples;
+
+  inline glm::dvec3 sample(size_t i) const { return samples[i]; }
+  inline double time(size_t i) const { return times[i]; }
+  inline float intensity(size_t /*i*/) const { return 0.0f; }
+};
+
+/// Reads single precision, structure of arrays samples.
+struct SoaSamples
+{
+  const LocalSamples &samples;
+
+  inline glm::dvec3 sample(size_t i) const { return glm::dvec3(samples.x[i], samples.y[i], samples.z[i]); }
+  inline double time(size_t i) const { return samples.timestamps[i]; }
+  inline float intensity(size_t i) const { return samples.intensities[i]; }
+};
+
+
+/// Transform the samples in [begin, end) read from the @p Samples accessor. Implements both public overloads.
+template <typename Samples>
+size_t transformSamples(const SensorTrajectory &trajectory, const Samples &samples, size_t begin, size_t end,
+                        bool use_threads, std::vector<glm::dvec3> &output_rays, double max_range,
+                        std::vector<double> *output_times, std::vector<float> *output_intensities)
+{
+  output_rays.clear();
+  if (output_times)
+  {
+    output_times->clear();
+  }
+  if (output_intensities)
+  {
+    output_intensities->clear();
+  }
+
+  if (end <= begin || trajectory.count == 0)
+  {
+    return 0u;
+  }
+
+  const double *transform_times = trajectory.times;
+  const unsigned transform_count = trajectory.count;
+  const std::vector<TrajectorySegment> segments =
+    buildSegments(transform_times, trajectory.translations, trajectory.rotations, transform_count);
+  const double first_time = transform_times[0];
+  const double last_time = transform_times[transform_count - 1];
+  const double max_range_sqr = max_range * max_range;
+  const size_t point_count = end - begin;
+  const size_t chunk_count = (point_count + kSamplesPerChunk - 1) / kSamplesPerChunk;
+
+  // First pass: count the valid samples in each chunk to resolve the output offsets.
+  std::vector<size_t> chunk_offsets(chunk_count + 1, 0u);
+  parallelFor(chunk_count, use_threads, [&](size_t chunk_begin, size_t chunk_end) {
+    for (size_t c = chunk_begin; c < chunk_end; ++c)
+    {
+      size_t valid_count = 0;
+      const size_t sample_end = begin + std::min((c + 1) * kSamplesPerChunk, point_count);
+      for (size_t i = begin + c * kSamplesPerChunk; i < sample_end; ++i)
+      {
+        valid_count += goodSample(samples.sample(i), max_range_sqr);
+      }
+      chunk_offsets[c + 1] = valid_count;
+    }
+  });
+
+  for (size_t c = 0; c < chunk_count; ++c)
+  {
+    chunk_offsets[c + 1] += chunk_offsets[c];
+  }
+
+  const size_t valid_count = chunk_offsets[chunk_count];
+  output_rays.resize(valid_count * 2);
+  if (output_times)
+  {
+    output_times->resize(valid_count);
+  }
+  if (output_intensities)
+  {
+    output_intensities->resize(valid_count);
+  }
+
+  // Second pass: transform the valid samples.
+  parallelFor(chunk_count, use_threads, [&](size_t chunk_begin, size_t chunk_end) {
+    for (size_t c = chunk_begin; c < chunk_end; ++c)
+    {
+      size_t out_index = chunk_offsets[c];
+      unsigned segment_index = 0;
+      const size_t sample_end = begin + std::min((c + 1) * kSamplesPerChunk, point_count);
+      for (size_t i = begin + c * kSamplesPerChunk; i < sample_end; ++i)
+      {
+        const glm::dvec3 sample = samples.sample(i);
+        if (!goodSample(sample, max_range_sqr))
+        {
+          continue;
+        }
+
+        const double sample_time = samples.time(i);
+        const double time = std::max(first_time, std::min(sample_time, last_time));
+        segment_index = findSegment(transform_times, transform_count, time, segment_index);
+        const TrajectorySegment &segment = segments[segment_index];
+
+        const double t = std::max(0.0, std::min((time - segment.start_time) * segment.inv_duration, 1.0));
+        const glm::dvec3 position = segment.from_position + t * segment.delta_position;
+        double coeff_from = 1.0 - t;
+        double coeff_to = t;
+        if (segment.angle > 0)
+        {
+          coeff_from = std::sin((1.0 - t) * segment.angle) * segment.inv_sin_angle;
+          coeff_to = std::sin(t * segment.angle) * segment.inv_sin_angle;
+        }
+        glm::dquat rotation = coeff_from * segment.from_rotation + coeff_to * segment.to_rotation;
+        if (segment.angle <= 0)
+        {
+          // Linear interpolation does not preserve the unit length.
+          rotation = glm::normalize(rotation);
+        }
+
+        output_rays[out_index * 2 + 0] = position;
+        output_rays[out_index * 2 + 1] = position + rotation * sample;
+        if (output_times)
+        {
+          (*output_times)[out_index] = sample_time;
+        }
+        if (output_intensities)
+        {
+          (*output_intensities)[out_index] = samples.intensity(i);
+        }
+        ++out_index;
+      }
+    }
+  });
+
+  return valid_count;
+}
+}  // namespace
+
+
+TransformSamplesCpu::TransformSamplesCpu() = default;
+
+
+TransformSamplesCpu::~TransformSamplesCpu() = default;
+
+
+bool TransformSamplesCpu::useThreads() const
+{
+#ifdef OHM_FEATURE_THREADS
+  return use_threads_;
+#else   // OHM_FEATURE_THREADS
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+size_t TransformSamplesCpu::transform(const double *transform_times, const glm::dvec3 *transform_translations,
+                                      const glm::dquat *transform_rotations, unsigned transform_count,
+                                      const double *sample_times, const glm::dvec3 *local_samples, size_t point_count,
+                                      std::vector<glm::dvec3> &output_rays, double max_range,
+                                      std::vector<double> *output_times) const
+{
+  SensorTrajectory trajectory;
+  trajectory.times = transform_times;
+  trajectory.translations = transform_translations;
+  trajectory.rotations = transform_rotations;
+  trajectory.count = transform_count;
+  const VectorSamples samples{ sample_times, local_samples };
+  return transformSamples(trajectory, samples, 0, point_count, useThreads(), output_rays, max_range, output_times,
+                          nullptr);
+}
+
+
+size_t TransformSamplesCpu::transform(const SensorTrajectory &trajectory, const LocalSamples &samples, size_t begin,
+                                      size_t end, std::vector<glm::dvec3> &output_rays, double max_range,
+                                      std::vector<double> *output_times, std::vector<float> *output_intensities) const
+{
+  end = std::min(end, samples.count);
+  if (!samples.intensities && output_intensities)
+  {
+    // No intensities to compact.
+    output_intensities->clear();
+    output_intensities = nullptr;
+  }
+  const SoaSamples soa_samples{ samples };
+  return transformSamples(trajectory, soa_samples, begin, end, useThreads(), output_rays, max_range, output_times,
+                          output_intensities);
+}
+}  // namespace ohm
@@ -0,0 +1,126 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_TRANSFORMSAMPLESCPU_H
+#define OHM_TRANSFORMSAMPLESCPU_H
+
+#include "OhmConfig.h"
+
+#include <glm/fwd.hpp>
+
+#include <limits>
+#include <vector>
+
+namespace ohm
+{
+/// A sensor trajectory of timestamped local to global transforms. The arrays are not owned and each contain @c count
+/// entries with @c times sorted in increasing order.
+struct ohm_API SensorTrajectory
+{
+  const double *times = nullptr;             ///< Transform timestamps.
+  const glm::dvec3 *translations = nullptr;  ///< Transform translations.
+  const glm::dquat *rotations = nullptr;     ///< Transform rotations.
+  unsigned count = 0;                        ///< Number of transforms.
+};
+
+/// Sensor frame samples in a structure of arrays layout. The arrays are not owned and each contain @c count entries.
+struct ohm_API LocalSamples
+{
+  const float *x = nullptr;            ///< Sample x coordinates in the sensor frame.
+  const float *y = nullptr;            ///< Sample y coordinates in the sensor frame.
+  const float *z = nullptr;            ///< Sample z coordinates in the sensor frame.
+  const double *timestamps = nullptr;  ///< Per sample timestamps.
+  const float *intensities = nullptr;  ///< Optional per sample intensities. May be null.
+  size_t count = 0;                    ///< Number of samples.
+};
+
+/// CPU implementation of the @c GpuTransformSamples operation, transforming local sensor samples into global rays
+/// using an interpolated trajectory.
+///
+/// This is intended as a shared stage ahead of the CPU @c RayMapper implementations, such as
+/// @c RayMapperOccupancy and @c RayMapperNdt , which expect global origin/sample ray pairs:
+/// @code
+/// ohm::TransformSamplesCpu transformer;
+/// std::vector<glm::dvec3> rays;
+/// std::vector<double> ray_times;
+/// transformer.transform(traj_times, traj_positions, traj_rotations, traj_count, sample_times, local_samples,
+///                       sample_count, rays, max_range, &ray_times);
+/// mapper.integrateRays(rays.data(), rays.size(), nullptr, ray_times.data(), ohm::kRfDefault);
+/// @endcode
+///
+/// Samples are processed in fixed size chunks, split across threads when built with @c OHM_FEATURE_THREADS and
+/// @c useThreads() is set. The spherical interpolation parameters are calculated once for each trajectory segment,
+/// so the per sample work is a transform lookup, which mostly continues from the previous sample, a linear
+/// position interpolation, two @c sin() evaluations and a rotation. Calculations are performed in double precision.
+class ohm_API TransformSamplesCpu
+{
+public:
+  /// Constructor.
+  TransformSamplesCpu();
+  /// Destructor.
+  ~TransformSamplesCpu();
+
+  /// Enable or disable multi-threaded transformation. Ignored unless built with @c OHM_FEATURE_THREADS .
+  /// @param use_threads True to enable threaded transformation.
+  inline void setUseThreads(bool use_threads) { use_threads_ = use_threads; }
+  /// Is multi-threaded transformation enabled? Always false when not built with @c OHM_FEATURE_THREADS .
+  /// @return True if threaded transformation is enabled and available.
+  bool useThreads() const;
+
+  /// Transform @p local_samples from a local sensor frame into a global frame.
+  ///
+  /// The arguments match @c GpuTransformSamples::transform() . Each sample is transformed by the local to global
+  /// transform interpolated at its sample time: linear interpolation for the translation and spherical linear
+  /// interpolation for the rotation. Sample times outside the @p transform_times range use the first or last
+  /// transform. The @p transform_times must be sorted in increasing order.
+  ///
+  /// Samples with NaN or infinite coordinates, or beyond the @p max_range from the sensor, are removed. The
+  /// remaining samples are written to @p output_rays as origin/sample pairs in the order they appear in
+  /// @p local_samples , with the sample times written to @p output_times when given.
+  ///
+  /// @param transform_times Array of timestamps for the local to global transforms.
+  /// @param transform_translations Array of translation components of the local to global transforms.
+  /// @param transform_rotations Array of quaternion rotations of the local to global transforms.
+  /// @param transform_count number of entries in @p transform_times, @p transform_translations and
+  ///   @p transform_rotations.
+  /// @param sample_times Array of timestamps for @p local_samples.
+  /// @param local_samples The sample points to transform in local sensor space.
+  /// @param point_count Number of items in @p local_samples and @p sample_times.
+  /// @param output_rays Resized to hold the global origin/sample pairs for each valid sample.
+  /// @param max_range Maximum allowed distance length of a valid ray (sensor to sample distance).
+  ///   Longer rays are rejected.
+  /// @param output_times Optional array resized to hold the timestamp for each valid sample.
+  /// @return The number of valid samples transformed; half the size of @p output_rays .
+  size_t transform(const double *transform_times, const glm::dvec3 *transform_translations,
+                   const glm::dquat *transform_rotations, unsigned transform_count, const double *sample_times,
+                   const glm::dvec3 *local_samples, size_t point_count, std::vector<glm::dvec3> &output_rays,
+                   double max_range = std::numeric_limits<double>::infinity(),
+                   std::vector<double> *output_times = nullptr) const;
+
+  /// Transform the @p samples in the index range [@p begin, @p end) using the given @p trajectory .
+  ///
+  /// This is equivalent to the array overload, but reads structure of arrays, single precision sensor samples. The
+  /// @c LocalSamples::intensities of the valid samples are written to @p output_intensities when both are given.
+  ///
+  /// @param trajectory The sensor trajectory.
+  /// @param samples The sensor frame samples.
+  /// @param begin Index of the first sample to transform.
+  /// @param end One past the index of the last sample to transform.
+  /// @param output_rays Resized to hold the global origin/sample pairs for each valid sample.
+  /// @param max_range Maximum allowed sensor to sample distance. Longer rays are rejected.
+  /// @param output_times Optional array resized to hold the timestamp for each valid sample.
+  /// @param output_intensities Optional array resized to hold the intensity for each valid sample.
+  /// @return The number of valid samples transformed; half the size of @p output_rays .
+  size_t transform(const SensorTrajectory &trajectory, const LocalSamples &samples, size_t begin, size_t end,
+                   std::vector<glm::dvec3> &output_rays, double max_range = std::numeric_limits<double>::infinity(),
+                   std::vector<double> *output_times = nullptr,
+                   std::vector<float> *output_intensities = nullptr) const;
+
+private:
+  bool use_threads_ = true;
+};
+}  // namespace ohm
+
+#endif  // OHM_TRANSFORMSAMPLESCPU_H
@@ -0,0 +1,386 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "VisibilityQuery.h"
+
+#include "private/QueryRegionCache.h"
+#include "private/VisibilityQueryDetail.h"
+
+#include "Key.h"
+#include "LineWalk.h"
+#include "MapFlag.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "OccupancySummary.h"
+#include "TaskArena.h"
+#include "VoxelOccupancy.h"
+#include "VoxelOrderCompute.h"
+
+#include <glm/glm.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace ohm
+{
+namespace
+{
+/// Parameters for @c segmentVisible() shared by all segments.
+struct VisibilityParams
+{
+  glm::ivec3 region_dim{ 0 };
+  VoxelOrder voxel_order = VoxelOrder::kRowMajor;
+  float occupancy_threshold = 0;
+  unsigned walk_flags = 0;
+  bool unknown_as_occupied = false;
+  bool include_end_points = false;
+};
+
+
+/// Check if the segment from @p start to @p end is free of occupied voxels, stopping at the first occupied voxel.
+bool segmentVisible(const OccupancyMap &map, QueryRegionCache &cache, const glm::dvec3 &start, const glm::dvec3 &end,
+                    const VisibilityParams &params)
+{
+  if (!params.include_end_points && map.voxelKey(start) == map.voxelKey(end))
+  {
+    // Only the excluded end point voxel is touched.
+    return true;
+  }
+
+  bool visible = true;
+  const auto visit = [&](const Key &key, double /*enter_range*/, double /*exit_range*/) -> bool {
+    const QueryCachedRegion &region = cache.region(key.regionKey());
+    bool occupied = params.unknown_as_occupied;
+    if (region.chunk)
+    {
+      const glm::ivec3 local_key(key.localKey());
+      if (region.summary && region.summary->emptyRunLength(local_key, params.occupancy_threshold,
+                                                           params.unknown_as_occupied) > 0)
+      {
+        // The summary shows the voxel cannot be occupied. No need to read it.
+        occupied = false;
+      }
+      else
+      {
+        float occupancy = unobservedOccupancyValue();
+        const uint8_t *occupancy_mem = region.buffer.voxelMemory();
+        if (occupancy_mem)
+        {
+          const unsigned voxel_index = voxelIndex(key.localKey(), params.region_dim, params.voxel_order);
+          memcpy(&occupancy, occupancy_mem + voxel_index * sizeof(occupancy), sizeof(occupancy));
+        }
+        occupied = (occupancy == unobservedOccupancyValue()) ? params.unknown_as_occupied :
+                                                               occupancy >= params.occupancy_threshold;
+      }
+    }
+
+    visible = !occupied;
+    return visible;
+  };
+
+  walkSegmentKeys(LineWalkContext(map, visit), start, end, params.walk_flags);
+  return visible;
+}
+
+
+/// Order the @p points by region so consecutive segments from a common source traverse similar regions.
+std::vector<size_t> sortByRegion(const OccupancyMap &map, const std::vector<glm::dvec3> &points)
+{
+  std::vector<glm::i16vec3> region_keys(points.size());
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    region_keys[i] = map.regionKey(points[i]);
+  }
+
+  std::vector<size_t> order(points.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::stable_sort(order.begin(), order.end(), [&region_keys](size_t a, size_t b) {
+    const glm::i16vec3 &ra = region_keys[a];
+    const glm::i16vec3 &rb = region_keys[b];
+    if (ra.z != rb.z)
+    {
+      return ra.z < rb.z;
+    }
+    if (ra.y != rb.y)
+    {
+      return ra.y < rb.y;
+    }
+    return ra.x < rb.x;
+  });
+  return order;
+}
+
+
+/// Bring the occupancy summaries up to date for the regions which may be traversed. All segments lie within the bounds
+/// of the source and target points. This must be done before the threaded evaluation as @c updateOccupancySummary() is
+/// not thread safe.
+void updateVisibilitySummaries(VisibilityQueryDetail &d)
+{
+  OccupancyMap &map = *d.map;
+  if ((map.flags() & MapFlag::kOccupancySummary) == MapFlag::kNone || d.sources.empty() || d.targets.empty())
+  {
+    return;
+  }
+
+  glm::dvec3 min_ext = d.sources.front();
+  glm::dvec3 max_ext = d.sources.front();
+  for (const auto *points : { &d.sources, &d.targets })
+  {
+    for (const glm::dvec3 &point : *points)
+    {
+      min_ext = glm::min(min_ext, point);
+      max_ext = glm::max(max_ext, point);
+    }
+  }
+  updateOccupancySummaries(map, min_ext, max_ext);
+}
+
+
+bool visibilityQueryCpu(VisibilityQueryDetail &d, bool use_threads)
+{
+  OccupancyMap &map = *d.map;
+  const int occupancy_layer = map.layout().occupancyLayer();
+  if (occupancy_layer < 0)
+  {
+    return false;
+  }
+
+  VisibilityParams params;
+  params.region_dim = map.regionVoxelDimensions();
+  params.voxel_order = map.layerVoxelOrder(occupancy_layer);
+  params.occupancy_threshold = map.occupancyThresholdValue();
+  params.unknown_as_occupied = (d.query_flags & kQfUnknownAsOccupied) != 0;
+  params.include_end_points = (d.query_flags & VisibilityQuery::kQfIncludeEndPointVoxels) != 0;
+  params.walk_flags = (params.include_end_points) ? 0u : unsigned(kExcludeStartVoxel | kExcludeEndVoxel);
+
+  updateVisibilitySummaries(d);
+
+  const size_t source_count = d.sources.size();
+  const size_t target_count = d.targets.size();
+  d.row_words = (target_count + 63u) / 64u;
+  d.visibility.assign(source_count * d.row_words, 0u);
+
+  const std::vector<size_t> target_order = sortByRegion(map, d.targets);
+
+  const auto evaluate_sources = [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; ++s)
+    {
+      // All segments from this source share the region cache around their common origin.
+      QueryRegionCache cache(map, occupancy_layer);
+      uint64_t *row = d.visibility.data() + s * d.row_words;
+      const glm::dvec3 &source = d.sources[s];
+      for (const size_t t : target_order)
+      {
+        // Symmetric queries walk each pair once, from the lower index.
+        if (d.symmetric && t <= s)
+        {
+          continue;
+        }
+
+        if (segmentVisible(map, cache, source, d.targets[t], params))
+        {
+          row[t / 64u] |= (uint64_t(1) << (t % 64u));
+        }
+      }
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, source_count, 1u),
+                        [&evaluate_sources](const tbb::blocked_range<size_t> &range) {
+                          evaluate_sources(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    evaluate_sources(0, source_count);
+  }
+
+  if (d.symmetric)
+  {
+    // Mirror the upper triangle and mark the diagonal visible.
+    for (size_t s = 0; s < source_count; ++s)
+    {
+      d.visibility[s * d.row_words + s / 64u] |= (uint64_t(1) << (s % 64u));
+      for (size_t t = s + 1; t < target_count; ++t)
+      {
+        if (d.visibility[s * d.row_words + t / 64u] & (uint64_t(1) << (t % 64u)))
+        {
+          d.visibility[t * d.row_words + s / 64u] |= (uint64_t(1) << (s % 64u));
+        }
+      }
+    }
+  }
+
+  d.number_of_results = source_count * target_count;
+  return true;
+}
+}  // namespace
+
+
+VisibilityQuery::VisibilityQuery(VisibilityQueryDetail *detail)
+  : Query(detail)
+{}
+
+
+VisibilityQuery::VisibilityQuery(unsigned query_flags)
+  : VisibilityQuery(new VisibilityQueryDetail)
+{
+  setQueryFlags(query_flags);
+}
+
+
+VisibilityQuery::VisibilityQuery(OccupancyMap &map, unsigned query_flags)
+  : VisibilityQuery(query_flags)
+{
+  setMap(&map);
+}
+
+
+VisibilityQuery::~VisibilityQuery()
+{
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
+}
+
+
+void VisibilityQuery::setSources(const glm::dvec3 *points, size_t point_count)
+{
+  VisibilityQueryDetail *d = imp();
+  d->sources.assign(points, points + point_count);
+  d->symmetric = false;
+}
+
+
+void VisibilityQuery::setTargets(const glm::dvec3 *points, size_t point_count)
+{
+  VisibilityQueryDetail *d = imp();
+  d->targets.assign(points, points + point_count);
+  d->symmetric = false;
+}
+
+
+void VisibilityQuery::setPoints(const glm::dvec3 *points, size_t point_count)
+{
+  VisibilityQueryDetail *d = imp();
+  d->sources.assign(points, points + point_count);
+  d->targets = d->sources;
+  d->symmetric = true;
+}
+
+
+const glm::dvec3 *VisibilityQuery::sources() const
+{
+  const VisibilityQueryDetail *d = imp();
+  return d->sources.data();
+}
+
+
+size_t VisibilityQuery::sourceCount() const
+{
+  const VisibilityQueryDetail *d = imp();
+  return d->sources.size();
+}
+
+
+const glm::dvec3 *VisibilityQuery::targets() const
+{
+  const VisibilityQueryDetail *d = imp();
+  return d->targets.data();
+}
+
+
+size_t VisibilityQuery::targetCount() const
+{
+  const VisibilityQueryDetail *d = imp();
+  return d->targets.size();
+}
+
+
+const uint64_t *VisibilityQuery::visibility() const
+{
+  const VisibilityQueryDetail *d = imp();
+  return d->visibility.data();
+}
+
+
+size_t VisibilityQuery::rowWords() const
+{
+  const VisibilityQueryDetail *d = imp();
+  return d->row_words;
+}
+
+
+bool VisibilityQuery::visible(size_t source, size_t target) const
+{
+  const VisibilityQueryDetail *d = imp();
+  const size_t word = source * d->row_words + target / 64u;
+  return word < d->visibility.size() && (d->visibility[word] & (uint64_t(1) << (target % 64u))) != 0;
+}
+
+
+bool VisibilityQuery::onExecute()
+{
+  VisibilityQueryDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return visibilityQueryCpu(*d, useThreads());
+}
+
+
+bool VisibilityQuery::onExecuteAsync()
+{
+  VisibilityQueryDetail *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  return executeCpuAsync([this]() { return VisibilityQuery::onExecute(); });
+}
+
+
+void VisibilityQuery::onReset(bool hard_reset)
+{
+  VisibilityQueryDetail *d = imp();
+  d->visibility.clear();
+  d->row_words = 0;
+  if (hard_reset)
+  {
+    d->sources.clear();
+    d->targets.clear();
+    d->symmetric = false;
+  }
+}
+
+
+VisibilityQueryDetail *VisibilityQuery::imp()
+{
+  return static_cast<VisibilityQueryDetail *>(imp_);
+}
+
+
+const VisibilityQueryDetail *VisibilityQuery::imp() const
+{
+  return static_cast<const VisibilityQueryDetail *>(imp_);
+}
+}  // namespace ohm
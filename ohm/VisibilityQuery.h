@@ -0,0 +1,160 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VISIBILITYQUERY_H
+#define OHM_VISIBILITYQUERY_H
+
+#include "OhmConfig.h"
+
+#include "Query.h"
+#include "QueryFlag.h"
+
+#include <glm/fwd.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+struct VisibilityQueryDetail;
+
+/// A query which calculates the line of sight visibility between each point in a set of source points and each point
+/// in a set of target points, such as between communications nodes or between candidate camera placements and
+/// targets.
+///
+/// A source/target pair is visible when the line segment between the points contains no occupied voxels. The walk
+/// along each segment terminates at the first occupied voxel, matching @c kRfStopOnFirstOccupied ray semantics.
+/// Unobserved voxels are considered free unless @c kQfUnknownAsOccupied is set. The voxels containing the source and
+/// target points are excluded from the test unless @c kQfIncludeEndPointVoxels is set, as points often lie on
+/// occupied surfaces.
+///
+/// The results are available as a bit matrix via @c visibility() , with a row for each source point and a bit for
+/// each target point. @c visible() provides a convenient check for a single pair. The @c numberOfResults() is the
+/// number of source/target pairs. The @c ranges() and @c intersectedVoxels() are not used.
+///
+/// Evaluation assigns each source point to a task, with all segments from that source walked by the same task. The
+/// segments share the region lookups and retained @c VoxelBuffer objects around their common origin, and the targets
+/// are visited in region order so consecutive segments traverse similar regions. For maps created with
+/// @c MapFlag::kOccupancySummary , the region summaries are brought up to date before evaluation and voxels in summary
+/// bricks which cannot contain occupied voxels are not read. Tasks run in parallel when built with
+/// @c OHM_FEATURE_THREADS and @c useThreads() is set.
+///
+/// Use @c setPoints() to evaluate the visibility between all pairs of a single point set. Only one segment is walked
+/// for each pair as visibility is symmetric.
+///
+/// The @c kQfGpuEvaluate flag is not supported and the query is always evaluated on CPU.
+class ohm_API VisibilityQuery : public Query
+{
+public:
+  /// Specialised @c QueryFlag values for this query.
+  enum Flag : unsigned
+  {
+    /// Include the voxels containing the source and target points in the visibility test.
+    kQfIncludeEndPointVoxels = kQfSpecialised << 0u,
+  };
+
+protected:
+  /// Constructor used for inherited objects. This supports deriving @p VisibilityQueryDetail into more specialised
+  /// forms.
+  /// @param detail pimple style data structure. When null, a @c VisibilityQueryDetail is allocated by this method.
+  explicit VisibilityQuery(VisibilityQueryDetail *detail);
+
+public:
+  /// Construct a new query.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag and @c Flag .
+  explicit VisibilityQuery(unsigned query_flags = 0u);
+
+  /// Construct a new query using the given parameters.
+  /// @param map The map to perform the query on.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag and @c Flag .
+  explicit VisibilityQuery(OccupancyMap &map, unsigned query_flags = 0u);
+
+  /// Destructor.
+  ~VisibilityQuery() override;
+
+  /// Set the source points, or rows of the @c visibility() matrix.
+  /// @param points The source points.
+  /// @param point_count Number of elements in @p points .
+  void setSources(const glm::dvec3 *points, size_t point_count);
+  /// @overload
+  void setSources(const std::vector<glm::dvec3> &points);
+
+  /// Set the target points, or columns of the @c visibility() matrix.
+  /// @param points The target points.
+  /// @param point_count Number of elements in @p points .
+  void setTargets(const glm::dvec3 *points, size_t point_count);
+  /// @overload
+  void setTargets(const std::vector<glm::dvec3> &points);
+
+  /// Set both the sources and targets to @p points to evaluate the visibility between all pairs of points. This walks
+  /// only one segment for each pair. The @c visibility() matrix is symmetric with a visible diagonal.
+  /// @param points The points.
+  /// @param point_count Number of elements in @p points .
+  void setPoints(const glm::dvec3 *points, size_t point_count);
+  /// @overload
+  void setPoints(const std::vector<glm::dvec3> &points);
+
+  /// Access the source points.
+  /// @return The source points. The number of elements is @c sourceCount() .
+  const glm::dvec3 *sources() const;
+  /// Query the number of source points.
+  /// @return The number of source points.
+  size_t sourceCount() const;
+
+  /// Access the target points.
+  /// @return The target points. The number of elements is @c targetCount() .
+  const glm::dvec3 *targets() const;
+  /// Query the number of target points.
+  /// @return The number of target points.
+  size_t targetCount() const;
+
+  /// Access the visibility bit matrix. Each source point has a row of @c rowWords() words, with bit `t % 64` of word
+  /// `t / 64` set when target `t` is visible from the source. Unused bits in the last word of each row are zero.
+  ///
+  /// Only valid once execution completes.
+  ///
+  /// @return The visibility matrix. The number of elements is `sourceCount() * rowWords()` .
+  const uint64_t *visibility() const;
+
+  /// Query the number of 64-bit words in each row of the @c visibility() matrix.
+  /// @return The row stride in words.
+  size_t rowWords() const;
+
+  /// Check if @p target is visible from @p source . Only valid once execution completes.
+  /// @param source The source point index.
+  /// @param target The target point index.
+  /// @return True if the pair is visible.
+  bool visible(size_t source, size_t target) const;
+
+protected:
+  bool onExecute() override;
+  bool onExecuteAsync() override;
+  void onReset(bool hard_reset) override;
+
+  /// Access internal details.
+  /// @return Internal details.
+  VisibilityQueryDetail *imp();
+  /// Access internal details.
+  /// @return Internal details.
+  const VisibilityQueryDetail *imp() const;
+};
+
+inline void VisibilityQuery::setSources(const std::vector<glm::dvec3> &points)
+{
+  setSources(points.data(), points.size());
+}
+
+inline void VisibilityQuery::setTargets(const std::vector<glm::dvec3> &points)
+{
+  setTargets(points.data(), points.size());
+}
+
+inline void VisibilityQuery::setPoints(const std::vector<glm::dvec3> &points)
+{
+  setPoints(points.data(), points.size());
+}
+}  // namespace ohm
+
+#endif  // OHM_VISIBILITYQUERY_H
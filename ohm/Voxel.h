@@ -48,20 +48,23 @@ struct VoxelChunkAccess
   /// @param layer_index The voxel memory index in chunk which has been modified.
   static void touch(OccupancyMap *map, MapChunk *chunk, int layer_index)
   {
-    chunk->dirty_stamp = map->touch();
-    chunk->touched_stamps[layer_index].store(chunk->dirty_stamp, std::memory_order_relaxed);
+    const uint64_t stamp = map->touch();
+    chunk->markDirty(stamp);
+    chunk->touched_stamps[layer_index].store(stamp, std::memory_order_relaxed);
   }
 
   /// Write the @p value to the voxel at @p voxel_index within @p voxel_memory .
   /// @param voxel_memory Start of the voxel memory.
-  /// @param voxel_index Index of the voxel within @p voxel_memory - strided by @c T .
+  /// @param voxel_index Index of the voxel within @p voxel_memory - strided by @p voxel_stride .
+  /// @param voxel_stride Byte stride between voxels. Generally @c sizeof(T) , but larger for a
+  ///   @c MapLayer::kGroupMember layer.
   /// @param value The value to write.
   /// @param flags_change Flags to set in @p flags .
   /// @param flags Flags to modify by setting @p flags_change .
-  static void writeVoxel(uint8_t *voxel_memory, unsigned voxel_index, const T &value, unsigned flags_change,
-                         uint16_t *flags)
+  static void writeVoxel(uint8_t *voxel_memory, unsigned voxel_index, unsigned voxel_stride, const T &value,
+                         unsigned flags_change, uint16_t *flags)
   {
-    memcpy(voxel_memory + sizeof(T) * voxel_index, &value, sizeof(T));
+    memcpy(voxel_memory + voxel_stride * voxel_index, &value, sizeof(T));
     *flags |= flags_change;
   }
 };
@@ -96,8 +99,8 @@ struct VoxelChunkAccess<const T>
     (void)layer_index;
   }
 
-  static void writeVoxel(uint8_t voxel_memory, unsigned voxel_index, const T &value, unsigned flags_change,
-                         uint16_t *flags) = delete;
+  static void writeVoxel(uint8_t voxel_memory, unsigned voxel_index, unsigned voxel_stride, const T &value,
+                         unsigned flags_change, uint16_t *flags) = delete;
 };
 }  // namespace detail
 
@@ -408,6 +411,9 @@ public:
   /// Query the cached @c MapLayer::dimensions() .
   /// @return The map layer voxel dimensions.
   inline glm::u8vec3 layerDim() const { return layer_dim_; }
+  /// Query the cached @c VoxelOrder for the layer - see @c OccupancyMap::layerVoxelOrder() .
+  /// @return The map layer voxel order.
+  inline VoxelOrder layerVoxelOrder() const { return voxel_order_; }
   /// Query the status @c Flag values for the voxel. These are generally book keeping flags.
   /// @return The current status flags.
   inline unsigned flags() const { return flags_; }
@@ -439,7 +445,7 @@ public:
   /// Resolve the linearised voxel index into the @c MapChunk layer. @c isValidReference() must be true before
   /// calling.
   /// @return The linear voxel index resolved from the key.
-  inline unsigned voxelIndex() const { return ohm::voxelIndex(key_, layer_dim_); }
+  inline unsigned voxelIndex() const { return ohm::voxelIndex(key_, layer_dim_, voxel_order_); }
 
   /// Access the data for the current voxel. This is a convenience wrapper for the @c read() function which returns
   /// the template data type. Only call if @c isValid() is true.
@@ -460,7 +466,7 @@ public:
   /// @return The read value - i.e., `*value`.
   inline const DataType &read(DataType *value) const
   {
-    memcpy(value, voxel_memory_ + sizeof(T) * voxelIndex(), sizeof(T));
+    memcpy(value, voxel_memory_ + voxel_stride_ * voxelIndex(), sizeof(T));
     return *value;
   }
 
@@ -473,7 +479,7 @@ public:
   /// @param[in] value Value to write for the current voxel.
   inline void write(const DataType &value)
   {
-    detail::VoxelChunkAccess<T>::writeVoxel(voxel_memory_, voxelIndex(), value,
+    detail::VoxelChunkAccess<T>::writeVoxel(voxel_memory_, voxelIndex(), voxel_stride_, value,
                                             unsigned(Flag::kTouchedChunk) | unsigned(Flag::kTouchedVoxel), &flags_);
   }
 
@@ -482,6 +488,11 @@ public:
   /// @return A pointer to the voxel memory for the currently referenced chunk.
   inline VoxelDataPtr voxelMemory() const { return voxel_memory_; }
 
+  /// Query the byte stride between voxels in @c voxelMemory() . This is @c sizeof(T) except for a
+  /// @c MapLayer::kGroupMember layer. See @c MapLayer::voxelStride() .
+  /// @return The voxel byte stride.
+  inline unsigned voxelStride() const { return voxel_stride_; }
+
   /// Attempt to step the voxel reference to the next voxel in the current @c MapChunk .
   ///
   /// This first validates @c isValidReference() before attempting to modify the @c key() . On success, the
@@ -569,7 +580,9 @@ private:
   MapChunkPtr chunk_ = nullptr;          ///< Current @c MapChunk pointer - may be null even with a valid key reference.
   Key key_ = Key::kNull;                 ///< Current voxel @c Key reference.
   int layer_index_ = -1;                 ///< The target map layer. Validated on construction.
+  unsigned voxel_stride_ = unsigned(sizeof(T));  ///< Byte stride between voxels in @c voxel_memory_ .
   glm::u8vec3 layer_dim_{ 0, 0, 0 };     ///< The voxel dimensions of the layer.
+  VoxelOrder voxel_order_ = VoxelOrder::kRowMajor;  ///< The voxel memory order of the layer.
   uint16_t flags_ = 0;                   ///< Current status/book keeping flags
   uint16_t error_flags_ = 0;             ///< Current error flags.
 };
@@ -653,7 +666,9 @@ Voxel<T>::Voxel(const Voxel<T> &other)
   , chunk_(nullptr)
   , key_(other.key_)
   , layer_index_(other.layer_index_)
+  , voxel_stride_(other.voxel_stride_)
   , layer_dim_(other.layer_dim_)
+  , voxel_order_(other.voxel_order_)
   , flags_(other.flags_ & ~unsigned(Flag::kNonPropagatingFlags))
   , error_flags_(other.error_flags_)
 {
@@ -670,7 +685,9 @@ Voxel<T>::Voxel(Voxel<T> &&other) noexcept
   , chunk_(std::exchange(other.chunk_, nullptr))
   , key_(std::exchange(other.key_, Key::kNull))
   , layer_index_(std::exchange(other.layer_index_, -1))
+  , voxel_stride_(std::exchange(other.voxel_stride_, unsigned(sizeof(T))))
   , layer_dim_(std::exchange(other.layer_dim_, glm::u8vec3(0, 0, 0)))
+  , voxel_order_(std::exchange(other.voxel_order_, VoxelOrder::kRowMajor))
   , flags_(std::exchange(other.flags_, 0u))
   , error_flags_(std::exchange(other.error_flags_, 0u))
 {}
@@ -810,7 +827,9 @@ void Voxel<T>::swap(Voxel &other)
   std::swap(chunk_, other.chunk_);
   std::swap(key_, other.key_);
   std::swap(layer_index_, other.layer_index_);
+  std::swap(voxel_stride_, other.voxel_stride_);
   std::swap(layer_dim_, other.layer_dim_);
+  std::swap(voxel_order_, other.voxel_order_);
   std::swap(flags_, other.flags_);
   std::swap(error_flags_, other.error_flags_);
 }
@@ -825,7 +844,9 @@ Voxel<T> &Voxel<T>::operator=(const Voxel<T> &other)
     map_ = other.map_;
     setKeyInternal(other.key_);
     layer_index_ = other.layer_index_;
+    voxel_stride_ = other.voxel_stride_;
     layer_dim_ = other.layer_dim_;
+    voxel_order_ = other.voxel_order_;
     flags_ = other.flags_ & ~unsigned(Flag::kNonPropagatingFlags);
     error_flags_ = other.error_flags_;
     // Do not set chunk or voxel_memory_ pointers directly. Use the method call to ensure flags are correctly
@@ -869,6 +890,8 @@ void Voxel<T>::validateLayer()
     else
     {
       layer_dim_ = layer->dimensions(map_->regionVoxelDimensions());
+      voxel_order_ = resolveVoxelOrder(map_->voxelOrder(), layer_dim_);
+      voxel_stride_ = unsigned(layer->voxelStride());
     }
 
     flags_ &= ~unsigned(Flag::kIsOccupancyLayer);
@@ -882,7 +905,7 @@ void Voxel<T>::updateVoxelTouch()
 {
   if ((flags_ & unsigned(Flag::kIsOccupancyLayer) | unsigned(Flag::kTouchedVoxel)) && chunk_)
   {
-    detail::VoxelChunkAccess<T>::touch(chunk_, voxelIndex());
+    detail::VoxelChunkAccess<T>::touch(chunk_, ohm::voxelIndex(key_, layer_dim_));
   }
   flags_ &= ~unsigned(Flag::kTouchedVoxel);
 }
@@ -6,23 +6,58 @@
 #include "VoxelBlock.h"
 
 #include "MapLayer.h"
+#include "MapMemoryAccounting.h"
 #include "VoxelBlockCompressionQueue.h"
+#include "VoxelMemoryPool.h"
 
 #include "private/OccupancyMapDetail.h"
 
+#include <ohmutil/Profile.h>
+
 #include <zlib.h>
 
+#ifdef OHM_FEATURE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif  // OHM_FEATURE_LZ4
+
+#ifdef OHM_FEATURE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif  // OHM_FEATURE_ZSTD
+
 #include <algorithm>
 #include <cstring>
+#include <mutex>
 
 namespace ohm
 {
+/// Codec data for a @c VoxelBlock::CompressionControls::dictionary . Holds the prepared Zstd dictionaries for the
+/// selected compression level.
+struct VoxelBlockCompressionDictionary
+{
+  /// The raw dictionary data.
+  std::shared_ptr<const std::vector<uint8_t>> data;
+#ifdef OHM_FEATURE_ZSTD
+  /// Compression dictionary.
+  ZSTD_CDict *cdict = nullptr;
+  /// Decompression dictionary.
+  ZSTD_DDict *ddict = nullptr;
+
+  VoxelBlockCompressionDictionary() = default;
+  VoxelBlockCompressionDictionary(const VoxelBlockCompressionDictionary &) = delete;
+  VoxelBlockCompressionDictionary &operator=(const VoxelBlockCompressionDictionary &) = delete;
+  ~VoxelBlockCompressionDictionary()
+  {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+#endif  // OHM_FEATURE_ZSTD
+};
+
 namespace
 {
 const unsigned kDefaultBufferSize = 1024u;
-unsigned g_minimum_buffer_size = kDefaultBufferSize;
-int g_zlib_compression_level = Z_BEST_SPEED;
-int g_zlib_gzip_flag = 0;  // Use 16 to enable GZip.
 const int kWindowBits = 14;
 const int kZLibMemLevel = 8;
 const int kCompressionStrategy = Z_DEFAULT_STRATEGY;
@@ -31,65 +66,440 @@ const int kGZipCompressionFlag = 16;
 const unsigned kReleaseDelayMs = 500;
 /// When reserving compressed buffer space, device the uncompressed size by this factor.
 const unsigned kBufferReservationQutient = 10;
-}  // namespace
 
+/// A snapshot of the global compression settings.
+struct CompressionSettings
+{
+  unsigned minimum_buffer_size = kDefaultBufferSize;
+  VoxelBlock::CompressionLevel compression_level = VoxelBlock::kCompressFast;
+  VoxelBlock::CompressionType compression_type = VoxelBlock::kCompressDeflate;
+  std::shared_ptr<const VoxelBlockCompressionDictionary> dictionary;
+};
+
+/// Guards @c g_compression_settings . The settings are copied for each compression call as they may be changed while
+/// the compression thread is active.
+std::mutex g_compression_settings_mutex;
+CompressionSettings g_compression_settings;
 
-void VoxelBlock::getCompressionControls(CompressionControls *controls)
+CompressionSettings compressionSettings()
+{
+  std::unique_lock<std::mutex> guard(g_compression_settings_mutex);
+  return g_compression_settings;
+}
+
+int zlibCompressionLevel(VoxelBlock::CompressionLevel level)
+{
+  switch (level)
+  {
+  default:
+  case VoxelBlock::kCompressFast:
+    return Z_BEST_SPEED;
+  case VoxelBlock::kCompressBalanced:
+    return Z_DEFAULT_COMPRESSION;
+  case VoxelBlock::kCompressMax:
+    return Z_BEST_COMPRESSION;
+  }
+}
+
+bool compressZLib(const VoxelBytes &voxel_bytes, std::vector<uint8_t> &compression_buffer,
+                  const CompressionSettings &settings)
+{
+  const int gzip_flag = (settings.compression_type == VoxelBlock::kCompressGZip) ? kGZipCompressionFlag : 0;
+  int ret = Z_OK;
+  z_stream stream;
+  memset(&stream, 0u, sizeof(stream));
+  // NOLINTNEXTLINE(hicpp-signed-bitwise)
+  deflateInit2(&stream, zlibCompressionLevel(settings.compression_level), Z_DEFLATED, kWindowBits | gzip_flag,
+               kZLibMemLevel, kCompressionStrategy);
+
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+  stream.next_in = const_cast<Bytef *>(static_cast<const Bytef *>(voxel_bytes.data()));
+  stream.avail_in = unsigned(voxel_bytes.size());
+
+  compression_buffer.reserve(
+    std::max(voxel_bytes.size() / kBufferReservationQutient, static_cast<size_t>(settings.minimum_buffer_size)));
+  compression_buffer.resize(compression_buffer.capacity());
+
+  stream.avail_out = unsigned(compression_buffer.size());
+  stream.next_out = compression_buffer.data();
+
+  int flush_flag = Z_NO_FLUSH;
+  do
+  {
+    ret = deflate(&stream, flush_flag);
+
+    switch (ret)
+    {
+    case Z_OK:
+      // Done with input data. Make sure we change to flushing.
+      if (stream.avail_in == 0)
+      {
+        flush_flag = Z_FINISH;
+      }
+
+      // Check for insufficient output data before Z_STREAM_END.
+      if (stream.avail_out == 0)
+      {
+        // Output buffer too small.
+        const size_t bytes_so_far = compression_buffer.size();
+        compression_buffer.resize(2 * bytes_so_far);
+        stream.avail_out = unsigned(compression_buffer.size() - bytes_so_far);
+        stream.next_out = compression_buffer.data() + bytes_so_far;
+      }
+      break;
+    case Z_STREAM_END:
+      break;
+    default:
+      // Failed.
+      deflateEnd(&stream);
+      return false;
+    }
+  } while (stream.avail_in || ret != Z_STREAM_END);
+
+  // Ensure flush.
+  if (flush_flag != Z_FINISH)
+  {
+    deflate(&stream, Z_FINISH);
+  }
+
+  ret = deflateEnd(&stream);
+  if (ret != Z_OK)
+  {
+    return false;
+  }
+
+  // Resize compressed buffer.
+  compression_buffer.resize(compression_buffer.size() - stream.avail_out);
+  return true;
+}
+
+bool uncompressZLib(const std::vector<uint8_t> &voxel_bytes, VoxelBytes &expanded_buffer, bool gzip)
+{
+  const int gzip_flag = (gzip) ? kGZipCompressionFlag : 0;
+  int ret = Z_OK;
+  z_stream stream;
+  memset(&stream, 0u, sizeof(stream));
+  inflateInit2(&stream, kWindowBits | gzip_flag);  // NOLINT(hicpp-signed-bitwise)
+
+  stream.avail_in = unsigned(voxel_bytes.size());
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+  stream.next_in = const_cast<Bytef *>(static_cast<const Bytef *>(voxel_bytes.data()));
+
+  stream.avail_out = unsigned(expanded_buffer.size());
+  stream.next_out = static_cast<unsigned char *>(expanded_buffer.data());
+
+  int flush_flag = Z_NO_FLUSH;
+  do
+  {
+    ret = inflate(&stream, flush_flag);
+
+    switch (ret)
+    {
+    case Z_OK:
+      // Check for insufficient output data on flush or before finishing input data. This is an error an error condition
+      // as we know how large it should be.
+      if (stream.avail_out == 0 && (flush_flag == Z_FINISH || stream.avail_in))
+      {
+        // Failed.
+        inflateEnd(&stream);
+        return false;
+      }
+
+      // Transition to flush if there is no more input data.
+      if (stream.avail_in == 0)
+      {
+        flush_flag = Z_FINISH;
+      }
+      break;
+    case Z_STREAM_END:
+      break;
+    default:
+      // Failed.
+      inflateEnd(&stream);
+      return false;
+    }
+  } while (stream.avail_in || ret != Z_STREAM_END);
+
+  // Ensure flush.
+  if (flush_flag != Z_FINISH)
+  {
+    inflate(&stream, Z_FINISH);
+  }
+
+  // Resize compressed buffer.
+  expanded_buffer.resize(expanded_buffer.size() - stream.avail_out);
+  inflateEnd(&stream);
+
+  return true;
+}
+
+#ifdef OHM_FEATURE_LZ4
+bool compressLz4(const VoxelBytes &voxel_bytes, std::vector<uint8_t> &compression_buffer,
+                 const CompressionSettings &settings)
 {
-  controls->minimum_buffer_size = g_minimum_buffer_size;
+  const int src_size = int(voxel_bytes.size());
+  compression_buffer.resize(LZ4_compressBound(src_size));
+  const auto *src = reinterpret_cast<const char *>(voxel_bytes.data());
+  auto *dst = reinterpret_cast<char *>(compression_buffer.data());
+  const int dst_capacity = int(compression_buffer.size());
 
-  switch (g_zlib_compression_level)
+  int compressed_size = 0;
+  switch (settings.compression_level)
   {
   default:
-  case Z_DEFAULT_COMPRESSION:
-    controls->compression_level = kCompressBalanced;
+  case VoxelBlock::kCompressFast:
+    compressed_size = LZ4_compress_default(src, dst, src_size, dst_capacity);
     break;
-  case Z_BEST_SPEED:
-    controls->compression_level = kCompressFast;
+  case VoxelBlock::kCompressBalanced:
+    compressed_size = LZ4_compress_HC(src, dst, src_size, dst_capacity, LZ4HC_CLEVEL_DEFAULT);
     break;
-  case Z_BEST_COMPRESSION:
-    controls->compression_level = kCompressMax;
+  case VoxelBlock::kCompressMax:
+    compressed_size = LZ4_compress_HC(src, dst, src_size, dst_capacity, LZ4HC_CLEVEL_MAX);
     break;
   }
 
-  if (g_zlib_gzip_flag)
+  if (compressed_size <= 0)
   {
-    controls->compression_type = kCompressGZip;
+    return false;
+  }
+
+  compression_buffer.resize(compressed_size);
+  return true;
+}
+
+bool uncompressLz4(const std::vector<uint8_t> &voxel_bytes, VoxelBytes &expanded_buffer)
+{
+  const int decompressed_size =
+    LZ4_decompress_safe(reinterpret_cast<const char *>(voxel_bytes.data()),
+                        reinterpret_cast<char *>(expanded_buffer.data()), int(voxel_bytes.size()),
+                        int(expanded_buffer.size()));
+  if (decompressed_size < 0)
+  {
+    return false;
+  }
+  expanded_buffer.resize(decompressed_size);
+  return true;
+}
+#endif  // OHM_FEATURE_LZ4
+
+#ifdef OHM_FEATURE_ZSTD
+int zstdCompressionLevel(VoxelBlock::CompressionLevel level)
+{
+  switch (level)
+  {
+  default:
+  case VoxelBlock::kCompressFast:
+    return 1;
+  case VoxelBlock::kCompressBalanced:
+    return ZSTD_CLEVEL_DEFAULT;
+  case VoxelBlock::kCompressMax:
+    return 19;
+  }
+}
+
+/// Zstd compression contexts. Contexts are expensive to create, so we maintain one set per thread.
+struct ZstdContexts
+{
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  ZSTD_DCtx *dctx = ZSTD_createDCtx();
+
+  ZstdContexts() = default;
+  ZstdContexts(const ZstdContexts &) = delete;
+  ZstdContexts &operator=(const ZstdContexts &) = delete;
+  ~ZstdContexts()
+  {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+};
+
+ZstdContexts &zstdContexts()
+{
+  static thread_local ZstdContexts contexts;
+  return contexts;
+}
+
+bool compressZstd(const VoxelBytes &voxel_bytes, std::vector<uint8_t> &compression_buffer,
+                  const CompressionSettings &settings)
+{
+  ZstdContexts &contexts = zstdContexts();
+  compression_buffer.resize(ZSTD_compressBound(voxel_bytes.size()));
+  size_t compressed_size = 0;
+  if (settings.dictionary)
+  {
+    compressed_size = ZSTD_compress_usingCDict(contexts.cctx, compression_buffer.data(), compression_buffer.size(),
+                                               voxel_bytes.data(), voxel_bytes.size(), settings.dictionary->cdict);
+  }
+  else
+  {
+    compressed_size =
+      ZSTD_compressCCtx(contexts.cctx, compression_buffer.data(), compression_buffer.size(), voxel_bytes.data(),
+                        voxel_bytes.size(), zstdCompressionLevel(settings.compression_level));
+  }
+
+  if (ZSTD_isError(compressed_size))
+  {
+    return false;
+  }
+
+  compression_buffer.resize(compressed_size);
+  return true;
+}
+
+bool uncompressZstd(const std::vector<uint8_t> &voxel_bytes, VoxelBytes &expanded_buffer,
+                    const VoxelBlockCompressionDictionary *dictionary)
+{
+  ZstdContexts &contexts = zstdContexts();
+  size_t decompressed_size = 0;
+  if (dictionary)
+  {
+    decompressed_size = ZSTD_decompress_usingDDict(contexts.dctx, expanded_buffer.data(), expanded_buffer.size(),
+                                                   voxel_bytes.data(), voxel_bytes.size(), dictionary->ddict);
   }
   else
   {
-    controls->compression_type = kCompressDeflate;
+    decompressed_size = ZSTD_decompressDCtx(contexts.dctx, expanded_buffer.data(), expanded_buffer.size(),
+                                            voxel_bytes.data(), voxel_bytes.size());
   }
+
+  if (ZSTD_isError(decompressed_size))
+  {
+    return false;
+  }
+
+  expanded_buffer.resize(decompressed_size);
+  return true;
+}
+#endif  // OHM_FEATURE_ZSTD
+}  // namespace
+
+
+void VoxelBlock::getCompressionControls(CompressionControls *controls)
+{
+  const CompressionSettings settings = compressionSettings();
+  controls->minimum_buffer_size = settings.minimum_buffer_size;
+  controls->compression_level = settings.compression_level;
+  controls->compression_type = settings.compression_type;
+  controls->dictionary = (settings.dictionary) ? settings.dictionary->data : nullptr;
 }
 
 void VoxelBlock::setCompressionControls(const CompressionControls &controls)
 {
-  g_minimum_buffer_size = (controls.minimum_buffer_size > 0) ? controls.minimum_buffer_size : g_minimum_buffer_size;
+  std::unique_lock<std::mutex> guard(g_compression_settings_mutex);
+  CompressionSettings &settings = g_compression_settings;
+  settings.minimum_buffer_size =
+    (controls.minimum_buffer_size > 0) ? controls.minimum_buffer_size : settings.minimum_buffer_size;
   switch (controls.compression_level)
   {
   default:
   case kCompressFast:
-    g_zlib_compression_level = Z_BEST_SPEED;
+    settings.compression_level = kCompressFast;
     break;
   case kCompressBalanced:
-    g_zlib_compression_level = Z_DEFAULT_COMPRESSION;
+    settings.compression_level = kCompressBalanced;
     break;
   case kCompressMax:
-    g_zlib_compression_level = Z_BEST_COMPRESSION;
+    settings.compression_level = kCompressMax;
     break;
   }
 
-  g_zlib_gzip_flag = (controls.compression_type == kCompressGZip) ? kGZipCompressionFlag : 0;
+  settings.compression_type =
+    (compressionTypeSupported(controls.compression_type)) ? controls.compression_type : kCompressDeflate;
+
+  settings.dictionary.reset();
+#ifdef OHM_FEATURE_ZSTD
+  if (settings.compression_type == kCompressZstd && controls.dictionary && !controls.dictionary->empty())
+  {
+    auto dictionary = std::make_shared<VoxelBlockCompressionDictionary>();
+    dictionary->data = controls.dictionary;
+    dictionary->cdict = ZSTD_createCDict(controls.dictionary->data(), controls.dictionary->size(),
+                                         zstdCompressionLevel(settings.compression_level));
+    dictionary->ddict = ZSTD_createDDict(controls.dictionary->data(), controls.dictionary->size());
+    if (dictionary->cdict && dictionary->ddict)
+    {
+      settings.dictionary = dictionary;
+    }
+  }
+#endif  // OHM_FEATURE_ZSTD
+}
+
+
+bool VoxelBlock::compressionTypeSupported(CompressionType type)
+{
+  switch (type)
+  {
+  case kCompressDeflate:
+  case kCompressGZip:
+    return true;
+#ifdef OHM_FEATURE_LZ4
+  case kCompressLz4:
+    return true;
+#endif  // OHM_FEATURE_LZ4
+#ifdef OHM_FEATURE_ZSTD
+  case kCompressZstd:
+    return true;
+#endif  // OHM_FEATURE_ZSTD
+  default:
+    break;
+  }
+  return false;
+}
+
+
+bool VoxelBlock::trainCompressionDictionary(const std::vector<VoxelBlock *> &blocks, size_t dictionary_size,
+                                            std::vector<uint8_t> &dictionary)
+{
+#ifdef OHM_FEATURE_ZSTD
+  std::vector<uint8_t> samples;
+  std::vector<size_t> sample_sizes;
+  sample_sizes.reserve(blocks.size());
+  for (VoxelBlock *block : blocks)
+  {
+    block->retain();
+    samples.insert(samples.end(), block->voxel_bytes_.begin(), block->voxel_bytes_.end());
+    sample_sizes.emplace_back(block->voxel_bytes_.size());
+    block->release();
+  }
+
+  dictionary.resize(dictionary_size);
+  const size_t trained_size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                                                    sample_sizes.data(), unsigned(sample_sizes.size()));
+  if (ZDICT_isError(trained_size))
+  {
+    dictionary.clear();
+    return false;
+  }
+
+  dictionary.resize(trained_size);
+  return true;
+#else   // OHM_FEATURE_ZSTD
+  (void)blocks;
+  (void)dictionary_size;
+  dictionary.clear();
+  return false;
+#endif  // OHM_FEATURE_ZSTD
 }
 
 
-VoxelBlock::VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer)
+VoxelBlock::VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer, bool deferred_init)
   : map_(map)
   , layer_index_(layer.layerIndex())
   , uncompressed_byte_size_(layer.layerByteSize(map->region_voxel_dimensions))
+  , memory_pool_(map->memory_pool)
+  , memory_accounting_(map->memory_accounting)
 {
-  initUncompressed(voxel_bytes_, layer);
-  flags_ |= kFUncompressed;
+  last_release_ = Clock::now().time_since_epoch().count();
+  if (deferred_init || (map->flags & MapFlag::kUniformBlocks) == MapFlag::kUniformBlocks)
+  {
+    // Defer allocation until first retained. The empty voxel_bytes_ implies the layer clear pattern.
+    flags_ |= kFUniform;
+  }
+  else
+  {
+    initUncompressed(voxel_bytes_, layer);
+    flags_ |= kFUncompressed;
+  }
+  updateAccountingUnguarded();
   // Try add to compression process if the map uses compression.
   if ((map->flags & MapFlag::kCompressed) == MapFlag::kCompressed)
   {
@@ -98,7 +508,25 @@ VoxelBlock::VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer)
 }
 
 
-VoxelBlock::~VoxelBlock() = default;
+VoxelBlock::VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer, VoxelBlock *group_block)
+  : map_(map)
+  , layer_index_(layer.layerIndex())
+  , uncompressed_byte_size_(layer.layerByteSize(map->region_voxel_dimensions))
+  , group_block_(group_block)
+  , group_offset_(layer.groupOffset())
+  , group_stride_(unsigned(layer.voxelStride()))
+{
+  // No voxel memory of our own and never compressed.
+  flags_ |= kFGroupAlias;
+}
+
+
+VoxelBlock::~VoxelBlock()
+{
+  recycleVoxelBytesUnguarded();
+  compressed_bytes_.reset();
+  updateAccountingUnguarded();
+}
 
 
 void VoxelBlock::destroy()
@@ -120,35 +548,287 @@ void VoxelBlock::destroy()
 }
 
 
+size_t VoxelBlock::perVoxelByteSize() const
+{
+  return map_->layout.layer(layer_index_).voxelByteSize();
+}
+
+
 void VoxelBlock::retain()
 {
+  if (group_block_)
+  {
+    group_block_->retain();
+    return;
+  }
+
+  // Fast path: a block which is already retained is locked and uncompressed, so only the count need change. The count
+  // only leaves zero under the access_guard_, so a non zero count cannot race with compression.
+  uint32_t count = reference_count_.load(std::memory_order_acquire);
+  while (count > 0)
+  {
+    if (reference_count_.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel))
+    {
+      return;
+    }
+  }
+
   std::unique_lock<Mutex> guard(access_guard_);
-  ++reference_count_;
   flags_ |= kFLocked;  // Ensure block is lock to prevent compression.
   // Ensure uncompressed data are available.
   if (!(flags_ & kFUncompressed))
   {
-    std::vector<uint8_t> working_buffer;
-    uncompressUnguarded(working_buffer);
-    voxel_bytes_.swap(working_buffer);
-    flags_ |= kFUncompressed;
+    uncompressForAccessUnguarded();
+  }
+  // Increment last so the fast path never sees a non zero count before the voxel memory is ready.
+  reference_count_.fetch_add(1, std::memory_order_release);
+}
+
+
+void VoxelBlock::setCompressionHint(float distance, bool protect)
+{
+  if (group_block_)
+  {
+    group_block_->setCompressionHint(distance, protect);
+    return;
+  }
+
+  compression_distance_ = distance;
+  if (protect)
+  {
+    flags_ |= kFProtected;
+  }
+  else
+  {
+    flags_ &= ~kFProtected;
   }
 }
 
+
+void VoxelBlock::prefetch()
+{
+  if (group_block_)
+  {
+    group_block_->prefetch();
+    return;
+  }
+
+  std::unique_lock<Mutex> guard(access_guard_);
+  // Uniform blocks are cheap to expand on retain() and are better left without voxel memory until then.
+  if (!(flags_ & (kFUncompressed | kFUniform)))
+  {
+    uncompressForAccessUnguarded();
+  }
+}
+
+
+void VoxelBlock::uncompressForAccessUnguarded()
+{
+  VoxelBytes working_buffer;
+  if (memory_pool_)
+  {
+    memory_pool_->acquire(working_buffer, uncompressed_byte_size_);
+  }
+  uncompressUnguarded(working_buffer);
+  voxel_bytes_.swap(working_buffer);
+  compressed_bytes_.reset();
+  if (flags_ & kFUniform)
+  {
+    flags_ &= ~kFUniform;
+    if ((map_->flags & MapFlag::kUniformBlocks) == MapFlag::kUniformBlocks)
+    {
+      // Check for uniform content again on the last release.
+      flags_ |= kFUniformCandidate;
+    }
+  }
+  if (flags_ & kFDeferred)
+  {
+    // Loaded. Release the loader and check for uniform content as if expanded from the uniform state.
+    flags_ &= ~kFDeferred;
+    deferred_loader_.reset();
+    if ((map_->flags & MapFlag::kUniformBlocks) == MapFlag::kUniformBlocks)
+    {
+      flags_ |= kFUniformCandidate;
+    }
+  }
+  flags_ |= kFUncompressed;
+  updateAccountingUnguarded();
+}
+
+
 void VoxelBlock::release()
 {
+  if (group_block_)
+  {
+    group_block_->release();
+    return;
+  }
+
+  // Fast path: releasing any reference other than the last requires no state change.
+  uint32_t count = reference_count_.load(std::memory_order_acquire);
+  while (count > 1)
+  {
+    if (reference_count_.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+    {
+      return;
+    }
+  }
+
   std::unique_lock<Mutex> guard(access_guard_);
-  if (reference_count_ > 0)
+  // The fast paths may still change the count, but never take it below one, so only this thread can reach zero.
+  if (reference_count_.load(std::memory_order_acquire) > 0 &&
+      reference_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
   {
-    --reference_count_;
-    if (reference_count_ == 0)
+    // Unlock to allow compression.
+    flags_ &= ~kFLocked;
+    last_release_ = Clock::now().time_since_epoch().count();
+    if (flags_ & kFUniformCandidate && collapseUniformUnguarded())
     {
-      // Unlock to allow compression.
-      flags_ &= ~kFLocked;
+      updateAccountingUnguarded();
     }
   }
 }
 
+
+void VoxelBlock::reset()
+{
+  if (group_block_)
+  {
+    // Reset with the group block.
+    return;
+  }
+
+  std::unique_lock<Mutex> guard(access_guard_);
+  const MapLayer &layer = map_->layout.layer(layer_index_);
+  if ((map_->flags & MapFlag::kUniformBlocks) == MapFlag::kUniformBlocks)
+  {
+    // The empty voxel_bytes_ implies the layer clear pattern.
+    recycleVoxelBytesUnguarded();
+    compressed_bytes_.reset();
+    compressed_byte_size_ = 0;
+    deferred_loader_.reset();
+    flags_ &= ~(kFUncompressed | kFUniformCandidate | kFDeferred);
+    flags_ |= kFUniform;
+    updateAccountingUnguarded();
+    return;
+  }
+
+  if ((flags_ & kFUncompressed) && voxel_bytes_.size() == uncompressed_byte_size_)
+  {
+    // Clear in place.
+    layer.clear(voxel_bytes_.data(), map_->region_voxel_dimensions);
+  }
+  else
+  {
+    recycleVoxelBytesUnguarded();
+    initUncompressed(voxel_bytes_, layer);
+  }
+  compressed_bytes_.reset();
+  deferred_loader_.reset();
+  flags_ &= ~(kFUniform | kFUniformCandidate | kFDeferred);
+  flags_ |= kFUncompressed;
+  updateAccountingUnguarded();
+}
+
+
+bool VoxelBlock::copyFrom(const VoxelBlock &other)
+{
+  if (&other == this)
+  {
+    return true;
+  }
+
+  if (group_block_ || other.group_block_)
+  {
+    // Aliases hold no data of their own.
+    return false;
+  }
+
+  std::unique_lock<Mutex> guard(access_guard_, std::defer_lock);
+  std::unique_lock<Mutex> other_guard(other.access_guard_, std::defer_lock);
+  std::lock(guard, other_guard);
+
+  if (reference_count_ || uncompressed_byte_size_ != other.uncompressed_byte_size_)
+  {
+    return false;
+  }
+
+  VoxelBytes voxel_bytes;
+  if ((other.flags_ & kFUncompressed) && memory_pool_)
+  {
+    memory_pool_->acquire(voxel_bytes, uncompressed_byte_size_);
+  }
+  voxel_bytes.assign(other.voxel_bytes_.begin(), other.voxel_bytes_.end());
+  recycleVoxelBytesUnguarded();
+  voxel_bytes_.swap(voxel_bytes);
+  // Share compressed data by reference.
+  compressed_bytes_ = other.compressed_bytes_;
+  compressed_byte_size_ = other.compressed_byte_size_;
+  compressed_type_ = other.compressed_type_;
+  compressed_dictionary_ = other.compressed_dictionary_;
+  // Deferred data are loaded independently by each block.
+  deferred_loader_ = other.deferred_loader_;
+  const unsigned state_flags = kFUncompressed | kFUniform | kFDeferred;
+  flags_ = (flags_ & ~(state_flags | kFUniformCandidate)) | (other.flags_ & state_flags);
+  updateAccountingUnguarded();
+  return true;
+}
+
+
+bool VoxelBlock::sharesCompressedBytes(const VoxelBlock &other) const
+{
+  if (&other == this)
+  {
+    std::unique_lock<Mutex> guard(access_guard_);
+    return compressed_bytes_ != nullptr;
+  }
+
+  std::unique_lock<Mutex> guard(access_guard_, std::defer_lock);
+  std::unique_lock<Mutex> other_guard(other.access_guard_, std::defer_lock);
+  std::lock(guard, other_guard);
+  return compressed_bytes_ && compressed_bytes_ == other.compressed_bytes_;
+}
+
+
+bool VoxelBlock::compressedBytes(std::vector<uint8_t> &compressed_bytes, CompressionType *compression_type) const
+{
+  std::unique_lock<Mutex> guard(access_guard_);
+  if ((flags_ & (kFUncompressed | kFUniform | kFDeferred)) || !compressed_bytes_ || compressed_dictionary_)
+  {
+    return false;
+  }
+
+  compressed_bytes.assign(compressed_bytes_->begin(), compressed_bytes_->end());
+  *compression_type = CompressionType(compressed_type_);
+  return true;
+}
+
+
+bool VoxelBlock::setDeferredLoader(DeferredLoader loader)
+{
+  if (group_block_)
+  {
+    // Aliases hold no data of their own.
+    return false;
+  }
+
+  std::unique_lock<Mutex> guard(access_guard_);
+  if (reference_count_)
+  {
+    return false;
+  }
+
+  recycleVoxelBytesUnguarded();
+  compressed_bytes_.reset();
+  compressed_byte_size_ = 0;
+  compressed_dictionary_.reset();
+  deferred_loader_ = std::make_shared<const DeferredLoader>(std::move(loader));
+  flags_ &= ~(kFUncompressed | kFUniform | kFUniformCandidate);
+  flags_ |= kFDeferred;
+  updateAccountingUnguarded();
+  return true;
+}
+
 #if 0
 void VoxelBlock::compressInto(std::vector<uint8_t> &compression_buffer)
 {
@@ -176,8 +856,15 @@ size_t VoxelBlock::compressWithTemporaryBuffer(std::vector<uint8_t> &compression
 {
   std::unique_lock<Mutex> guard(access_guard_);
 
-  if (!reference_count_ && !(flags_ & kFLocked))
+  // Uniform and deferred blocks have no voxel memory to compress. Aliases are compressed with their group block.
+  if (!reference_count_ && !(flags_ & (kFLocked | kFUniform | kFGroupAlias | kFDeferred)))
   {
+    if (compressed_bytes_ && !(flags_ & kFUncompressed))
+    {
+      // Already compressed. Leave the compressed data as is: it may be shared.
+      return compressed_bytes_->size();
+    }
+
     // Handle uninitialised buffer. We may not have initialised the buffer yet, but this call requires data to be
     // compressed such as when used for serialisation to disk.
     if (voxel_bytes_.empty())
@@ -186,8 +873,16 @@ size_t VoxelBlock::compressWithTemporaryBuffer(std::vector<uint8_t> &compression
       flags_ |= kFUncompressed;
     }
 
-    compressUnguarded(compression_buffer);
-    setCompressedBytesUnguarded(compression_buffer);
+    const bool compressed = compressUnguarded(compression_buffer);
+    if (compressed)
+    {
+      setCompressedBytesUnguarded(compression_buffer);
+    }
+    updateAccountingUnguarded();
+    if (!compressed)
+    {
+      return 0;
+    }
     return compression_buffer.size();
   }
   return 0;
@@ -196,6 +891,14 @@ size_t VoxelBlock::compressWithTemporaryBuffer(std::vector<uint8_t> &compression
 void VoxelBlock::updateLayerIndex(unsigned layer_index)
 {
   std::unique_lock<Mutex> guard(access_guard_);
+  if (memory_accounting_ && layer_index != layer_index_)
+  {
+    // Move the accounted memory to the new layer.
+    const auto uncompressed = std::ptrdiff_t(accounted_uncompressed_bytes_);
+    const auto compressed = std::ptrdiff_t(accounted_compressed_bytes_);
+    memory_accounting_->adjust(layer_index_, -uncompressed, -compressed);
+    memory_accounting_->adjust(layer_index, uncompressed, compressed);
+  }
   layer_index_ = layer_index;
 }
 
@@ -206,166 +909,154 @@ bool VoxelBlock::supportsCompression() const
 
 bool VoxelBlock::compressUnguarded(std::vector<uint8_t> &compression_buffer)
 {
+  PROFILE(VoxelBlock_compress);
   if (flags_ & kFUncompressed)
   {
-    int ret = Z_OK;
-    z_stream stream;
-    memset(&stream, 0u, sizeof(stream));
-    // NOLINTNEXTLINE(hicpp-signed-bitwise)
-    deflateInit2(&stream, g_zlib_compression_level, Z_DEFLATED, kWindowBits | g_zlib_gzip_flag, kZLibMemLevel,
-                 kCompressionStrategy);
-
-    stream.next_in = static_cast<Bytef *>(voxel_bytes_.data());
-    stream.avail_in = unsigned(voxel_bytes_.size());
-
-    compression_buffer.reserve(
-      std::max(voxel_bytes_.size() / kBufferReservationQutient, static_cast<size_t>(g_minimum_buffer_size)));
-    compression_buffer.resize(compression_buffer.capacity());
-
-    stream.avail_out = unsigned(compression_buffer.size());
-    stream.next_out = compression_buffer.data();
-
-    int flush_flag = Z_NO_FLUSH;
-    do
-    {
-      ret = deflate(&stream, flush_flag);
-
-      switch (ret)
-      {
-      case Z_OK:
-        // Done with input data. Make sure we change to flushing.
-        if (stream.avail_in == 0)
-        {
-          flush_flag = Z_FINISH;
-        }
-
-        // Check for insufficient output data before Z_STREAM_END.
-        if (stream.avail_out == 0)
-        {
-          // Output buffer too small.
-          const size_t bytes_so_far = compression_buffer.size();
-          compression_buffer.resize(2 * bytes_so_far);
-          stream.avail_out = unsigned(compression_buffer.size() - bytes_so_far);
-          stream.next_out = compression_buffer.data() + bytes_so_far;
-        }
-        break;
-      case Z_STREAM_END:
-        break;
-      default:
-        // Failed.
-        deflateEnd(&stream);
-        return false;
-      }
-    } while (stream.avail_in || ret != Z_STREAM_END);
-
-    // Ensure flush.
-    if (flush_flag != Z_FINISH)
+    const CompressionSettings settings = compressionSettings();
+    bool ok = false;
+    switch (settings.compression_type)
     {
-      deflate(&stream, Z_FINISH);
+#ifdef OHM_FEATURE_LZ4
+    case kCompressLz4:
+      ok = compressLz4(voxel_bytes_, compression_buffer, settings);
+      break;
+#endif  // OHM_FEATURE_LZ4
+#ifdef OHM_FEATURE_ZSTD
+    case kCompressZstd:
+      ok = compressZstd(voxel_bytes_, compression_buffer, settings);
+      break;
+#endif  // OHM_FEATURE_ZSTD
+    default:
+      ok = compressZLib(voxel_bytes_, compression_buffer, settings);
+      break;
     }
 
-    ret = deflateEnd(&stream);
-    if (ret != Z_OK)
+    if (!ok)
     {
       return false;
     }
 
-    // Resize compressed buffer.
-    compression_buffer.resize(compression_buffer.size() - stream.avail_out);
+    // Record how the data are compressed for uncompressUnguarded().
+    compressed_type_ = uint8_t(settings.compression_type);
+    compressed_dictionary_ = settings.dictionary;
   }
   else
   {
     // Already compressed. Copy buffer.
-    compression_buffer.resize(voxel_bytes_.size());
-    if (!voxel_bytes_.empty())
+    compression_buffer.clear();
+    if (compressed_bytes_)
     {
-      memcpy(compression_buffer.data(), voxel_bytes_.data(), sizeof(*voxel_bytes_.data()) * voxel_bytes_.size());
+      compression_buffer.assign(compressed_bytes_->begin(), compressed_bytes_->end());
     }
   }
 
   return true;
 }
 
-bool VoxelBlock::uncompressUnguarded(std::vector<uint8_t> &expanded_buffer)
+bool VoxelBlock::uncompressUnguarded(VoxelBytes &expanded_buffer)
 {
-  if (voxel_bytes_.empty())
+  PROFILE(VoxelBlock_uncompress);
+  if (flags_ & kFDeferred)
   {
-    initUncompressed(voxel_bytes_, map_->layout.layer(layer_index_));
-    flags_ |= kFUncompressed;
+    expanded_buffer.resize(uncompressed_byte_size_);
+    if (!deferred_loader_ || !(*deferred_loader_)(expanded_buffer.data(), expanded_buffer.size()))
+    {
+      // Failed to load. Use the default values.
+      map_->layout.layer(layer_index_).clear(expanded_buffer.data(), map_->region_voxel_dimensions);
+      return false;
+    }
+    return true;
   }
 
-  if (flags_ & kFUncompressed)
+  if (flags_ & kFUniform)
   {
-    // Simply copy existing bytes.
-    expanded_buffer.resize(voxel_bytes_.size());
-    if (!voxel_bytes_.empty())
+    if (voxel_bytes_.empty())
     {
-      memcpy(expanded_buffer.data(), voxel_bytes_.data(), sizeof(*voxel_bytes_.data()) * voxel_bytes_.size());
+      // Default initialised values.
+      initUncompressed(expanded_buffer, map_->layout.layer(layer_index_));
+      return true;
+    }
+
+    // Replicate the fill value.
+    const size_t voxel_byte_size = voxel_bytes_.size();
+    expanded_buffer.resize(uncompressed_byte_size_);
+    for (size_t offset = 0; offset + voxel_byte_size <= expanded_buffer.size(); offset += voxel_byte_size)
+    {
+      memcpy(expanded_buffer.data() + offset, voxel_bytes_.data(), voxel_byte_size);
     }
     return true;
   }
 
-  expanded_buffer.resize(uncompressed_byte_size_);
-
-  int ret = Z_OK;
-  z_stream stream;
-  memset(&stream, 0u, sizeof(stream));
-  inflateInit2(&stream, kWindowBits | g_zlib_gzip_flag);  // NOLINT(hicpp-signed-bitwise)
-
-  stream.avail_in = unsigned(voxel_bytes_.size());
-  stream.next_in = voxel_bytes_.data();
+  if (!(flags_ & kFUncompressed) && compressed_bytes_)
+  {
+    expanded_buffer.resize(uncompressed_byte_size_);
+    const std::vector<uint8_t> &compressed_bytes = *compressed_bytes_;
+    switch (compressed_type_)
+    {
+#ifdef OHM_FEATURE_LZ4
+    case kCompressLz4:
+      return uncompressLz4(compressed_bytes, expanded_buffer);
+#endif  // OHM_FEATURE_LZ4
+#ifdef OHM_FEATURE_ZSTD
+    case kCompressZstd:
+      return uncompressZstd(compressed_bytes, expanded_buffer, compressed_dictionary_.get());
+#endif  // OHM_FEATURE_ZSTD
+    default:
+      break;
+    }
 
-  stream.avail_out = unsigned(expanded_buffer.size());
-  stream.next_out = static_cast<unsigned char *>(expanded_buffer.data());
+    return uncompressZLib(compressed_bytes, expanded_buffer, compressed_type_ == kCompressGZip);
+  }
 
-  int flush_flag = Z_NO_FLUSH;
-  do
+  if (voxel_bytes_.empty())
   {
-    ret = inflate(&stream, flush_flag);
+    initUncompressed(voxel_bytes_, map_->layout.layer(layer_index_));
+    flags_ |= kFUncompressed;
+  }
 
-    switch (ret)
-    {
-    case Z_OK:
-      // Check for insufficient output data on flush or before finishing input data. This is an error an error condition
-      // as we know how large it should be.
-      if (stream.avail_out == 0 && (flush_flag == Z_FINISH || stream.avail_in))
-      {
-        // Failed.
-        inflateEnd(&stream);
-        return false;
-      }
+  // Simply copy existing bytes.
+  expanded_buffer.resize(voxel_bytes_.size());
+  if (!voxel_bytes_.empty())
+  {
+    memcpy(expanded_buffer.data(), voxel_bytes_.data(), sizeof(*voxel_bytes_.data()) * voxel_bytes_.size());
+  }
+  return true;
+}
 
-      // Transition to flush if there is no more input data.
-      if (stream.avail_in == 0)
-      {
-        flush_flag = Z_FINISH;
-      }
-      break;
-    case Z_STREAM_END:
-      break;
-    default:
-      // Failed.
-      inflateEnd(&stream);
-      return false;
-    }
-  } while (stream.avail_in || ret != Z_STREAM_END);
 
-  // Ensure flush.
-  if (flush_flag != Z_FINISH)
+bool VoxelBlock::collapseUniformUnguarded()
+{
+  flags_ &= ~kFUniformCandidate;
+  const size_t voxel_byte_size = perVoxelByteSize();
+  if (!(flags_ & kFUncompressed) || voxel_byte_size == 0 || voxel_bytes_.size() < voxel_byte_size)
   {
-    inflate(&stream, Z_FINISH);
+    return false;
   }
 
-  // Resize compressed buffer.
-  expanded_buffer.resize(expanded_buffer.size() - stream.avail_out);
-  inflateEnd(&stream);
+  // The voxels are all equal when the memory matches itself offset by one voxel.
+  if (memcmp(voxel_bytes_.data(), voxel_bytes_.data() + voxel_byte_size, voxel_bytes_.size() - voxel_byte_size) != 0)
+  {
+    // Not uniform. The block stays dense from here on.
+    return false;
+  }
 
+  // Keep only the fill value.
+  VoxelBytes fill_value(voxel_bytes_.begin(), voxel_bytes_.begin() + voxel_byte_size);
+  recycleVoxelBytesUnguarded();
+  voxel_bytes_.swap(fill_value);
+  compressed_byte_size_ = voxel_bytes_.size();
+  flags_ &= ~kFUncompressed;
+  flags_ |= kFUniform;
   return true;
 }
 
 
-void VoxelBlock::initUncompressed(std::vector<uint8_t> &expanded_buffer, const MapLayer &layer)
+void VoxelBlock::initUncompressed(VoxelBytes &expanded_buffer, const MapLayer &layer)
 {
+  if (memory_pool_)
+  {
+    memory_pool_->acquire(expanded_buffer, uncompressedByteSize());
+  }
   expanded_buffer.resize(uncompressedByteSize());
   layer.clear(expanded_buffer.data(), map_->region_voxel_dimensions);
 }
@@ -373,14 +1064,46 @@ void VoxelBlock::initUncompressed(std::vector<uint8_t> &expanded_buffer, const M
 
 void VoxelBlock::setCompressedBytesUnguarded(const std::vector<uint8_t> &compressed_voxels)
 {
-  voxel_bytes_.resize(compressed_voxels.size());
-  if (!compressed_voxels.empty())
-  {
-    memcpy(voxel_bytes_.data(), compressed_voxels.data(), sizeof(*compressed_voxels.data()) * compressed_voxels.size());
-  }
-  voxel_bytes_.shrink_to_fit();
-  compressed_byte_size_ = voxel_bytes_.size();
+  compressed_bytes_ = std::make_shared<const std::vector<uint8_t>>(compressed_voxels.begin(), compressed_voxels.end());
+  recycleVoxelBytesUnguarded();
+  compressed_byte_size_ = compressed_bytes_->size();
   // Clear uncompressed flag.
   flags_ &= ~(kFUncompressed);
 }
+
+
+void VoxelBlock::recycleVoxelBytesUnguarded()
+{
+  if (memory_pool_ && voxel_bytes_.capacity() == uncompressed_byte_size_)
+  {
+    memory_pool_->release(voxel_bytes_);
+  }
+  else
+  {
+    VoxelBytes().swap(voxel_bytes_);
+  }
+}
+
+
+void VoxelBlock::updateAccountingUnguarded()
+{
+  if (!memory_accounting_)
+  {
+    return;
+  }
+
+  // Uniform fill values are accounted as compressed data.
+  const bool uncompressed = (flags_ & kFUncompressed) != 0;
+  const size_t uncompressed_bytes = (uncompressed) ? voxel_bytes_.capacity() : 0u;
+  const size_t compressed_bytes =
+    ((uncompressed) ? 0u : voxel_bytes_.capacity()) + ((compressed_bytes_) ? compressed_bytes_->capacity() : 0u);
+  if (uncompressed_bytes != accounted_uncompressed_bytes_ || compressed_bytes != accounted_compressed_bytes_)
+  {
+    memory_accounting_->adjust(
+      layer_index_, std::ptrdiff_t(uncompressed_bytes) - std::ptrdiff_t(accounted_uncompressed_bytes_),
+      std::ptrdiff_t(compressed_bytes) - std::ptrdiff_t(accounted_compressed_bytes_));
+    accounted_uncompressed_bytes_ = uncompressed_bytes;
+    accounted_compressed_bytes_ = compressed_bytes;
+  }
+}
 }  // namespace ohm
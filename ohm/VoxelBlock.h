@@ -8,6 +8,7 @@
 
 #include "OhmConfig.h"
 
+#include "HugePageAllocator.h"
 #include "Mutex.h"
 
 #include <glm/fwd.hpp>
@@ -15,14 +16,19 @@
 
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <vector>
 
 namespace ohm
 {
 class MapLayer;
+class MapMemoryAccounting;
 class VoxelBlockCompressionQueue;
+class VoxelMemoryPool;
 struct OccupancyMapDetail;
+struct VoxelBlockCompressionDictionary;
 
 /// A utility class used to track the memory for a dense voxel layer in a @c MapChunk. This class ensures voxel memory
 /// is uncompressed when requested and compressed using the background compression thread when no longer needed.
@@ -45,6 +51,20 @@ struct OccupancyMapDetail;
 /// The block also deals with cases where the background thread is in the process of compressing the voxel data while
 /// the reference count is non zero or when the background thread is processing the block when the map chunk is
 /// deleted.
+///
+/// For maps created with @c MapFlag::kUniformBlocks , a block starts in a uniform state (@c kFUniform ) where no
+/// voxel memory is allocated. The memory is expanded to the fill value on @c retain() , so this is transparent to
+/// @c VoxelBuffer and @c Voxel users. A block which was expanded from the uniform state is checked on the last
+/// @c release() and returns to the uniform state if every voxel still holds the same value. Otherwise the block
+/// remains dense and is not checked again.
+///
+/// A block for a @c MapLayer::kGroupMember layer is an alias into the block of its group layer (@c kFGroupAlias ).
+/// See @c MapLayout::addLayerGroup() . An alias has no voxel memory of its own: @c retain() and @c release() forward
+/// to the group block and @c voxelBytes() addresses the member's data within the interleaved group voxels. Voxels are
+/// then @c MapLayer::voxelStride() bytes apart. Compression and reset operations are handled by the group block.
+///
+/// A block may also be deferred (@c kFDeferred ) with voxel data to be loaded by a @c DeferredLoader on the first
+/// @c retain() - see @c setDeferredLoader() . This supports loading map layers lazily from file.
 class ohm_API VoxelBlock
 {
   friend VoxelBlockCompressionQueue;
@@ -79,9 +99,28 @@ public:
     /// Block is to be deleted. Only set when the block should be deleted but is currently on the compression thread.
     kFMarkedForDeath = (1u << 2u),
     /// Block is part of the compression system.
-    kFManagedForCompression = (1u << 3u)
+    kFManagedForCompression = (1u << 3u),
+    /// Block holds a single fill value for all voxels and has no voxel memory allocated. Used with
+    /// @c MapFlag::kUniformBlocks and for layers added by @c OccupancyMap::updateLayout() .
+    kFUniform = (1u << 4u),
+    /// Block memory was expanded from @c kFUniform and is to be checked for uniform content on the last @c release() .
+    kFUniformCandidate = (1u << 5u),
+    /// Block is an alias into the block of a layer group. See @c MapLayout::addLayerGroup() .
+    kFGroupAlias = (1u << 6u),
+    /// Block voxel data are yet to be loaded by the @c DeferredLoader . See @c setDeferredLoader() .
+    kFDeferred = (1u << 7u),
+    /// Block is queued for @c prefetch() by the compression queue. Defers deletion of a @c kFMarkedForDeath block
+    /// until the prefetch request has been serviced. See @c VoxelBlockCompressionQueue::prefetch() .
+    kFPrefetchPending = (1u << 8u),
+    /// Block is near the sensor and is compressed only after all unprotected blocks. See @c setCompressionHint() .
+    kFProtected = (1u << 9u)
   };
 
+  /// Function used to load the voxel data of a @c kFDeferred block. Invoked on the first @c retain() with the voxel
+  /// memory to populate and its byte size. Must return false on failure, in which case the voxels are cleared to the
+  /// layer default.
+  using DeferredLoader = std::function<bool(uint8_t *voxel_memory, size_t byte_size)>;
+
   /// Compression level options
   enum CompressionLevel
   {
@@ -99,7 +138,11 @@ public:
     /// ZLib deflate.
     kCompressDeflate,
     /// GZip compression.
-    kCompressGZip
+    kCompressGZip,
+    /// LZ4 block compression. Requires @c OHM_FEATURE_LZ4 .
+    kCompressLz4,
+    /// Zstandard compression, optionally using a @c CompressionControls::dictionary . Requires @c OHM_FEATURE_ZSTD .
+    kCompressZstd
   };
 
   /// Static compression controls.
@@ -111,6 +154,9 @@ public:
     CompressionLevel compression_level = kCompressFast;
     /// Voxel block compression technique.
     CompressionType compression_type = kCompressDeflate;
+    /// Optional dictionary used with @c kCompressZstd - see @c trainCompressionDictionary() . Ignored by other
+    /// compression types.
+    std::shared_ptr<const std::vector<uint8_t>> dictionary;
   };
 
   /// Get the current compression controls.
@@ -118,9 +164,31 @@ public:
   static void getCompressionControls(CompressionControls *controls);
   /// Set the voxel block compression controls. Should only be called before maps are created and voxel compression
   /// begins.
+  ///
+  /// Each block records the compression type and dictionary used when it is compressed, so changing the controls
+  /// only affects subsequent compression. A @c CompressionType which is not supported by this build falls back to
+  /// @c kCompressDeflate - see @c compressionTypeSupported() .
   /// @param controls New compression settings.
   static void setCompressionControls(const CompressionControls &controls);
 
+  /// Query whether @p type is available in this build.
+  /// @param type The compression type of interest.
+  /// @return True if @p type is supported.
+  static bool compressionTypeSupported(CompressionType type);
+
+  /// Train a @c kCompressZstd dictionary from the voxel content of @p blocks . The blocks should all be from the
+  /// same voxel layer as dictionaries are most effective for similar data. Each block is retained while sampled.
+  ///
+  /// Zstd dictionary training requires a reasonable number of samples; as a guide, the total sample size should be
+  /// around 100 times the @p dictionary_size .
+  ///
+  /// @param blocks The sample blocks.
+  /// @param dictionary_size The target dictionary size in bytes.
+  /// @param[out] dictionary The trained dictionary.
+  /// @return True on success, false on failure, or when built without @c OHM_FEATURE_ZSTD .
+  static bool trainCompressionDictionary(const std::vector<VoxelBlock *> &blocks, size_t dictionary_size,
+                                         std::vector<uint8_t> &dictionary);
+
   /// Create a voxel block within the given @p map for the given @p layer_index.
   ///
   /// @note At the time of the call, there are cases where the @p layer will not match the layout in @p map. This
@@ -128,7 +196,16 @@ public:
   /// @c VoxelBlock .
   /// @param map Details of the occupancy map to which the block belongs.
   /// @param layer The @p MapLayer which the voxel block represents.
-  VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer);
+  /// @param deferred_init Start in the @c kFUniform state, deferring allocation until first retained, even when the
+  ///   map does not use @c MapFlag::kUniformBlocks . The block is not collapsed back to the uniform state in that case.
+  VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer, bool deferred_init = false);
+
+  /// Create a @c kFGroupAlias voxel block for the @c MapLayer::kGroupMember @p layer , addressing the member data
+  /// within @p group_block . The @p group_block must outlive this block.
+  /// @param map Details of the occupancy map to which the block belongs.
+  /// @param layer The group member @p MapLayer which the voxel block represents.
+  /// @param group_block The block for the @c MapLayer::groupLayer() of @p layer .
+  VoxelBlock(const OccupancyMapDetail *map, const MapLayer &layer, VoxelBlock *group_block);
 
 private:
   /// Hidden destructor for dealing with the processing queue safely.
@@ -159,16 +236,93 @@ public:
   /// Query current flag values.
   inline unsigned flags() const { return flags_; }
 
+  /// Query the group block for a @c kFGroupAlias block.
+  /// @return The group block or null when this is not an alias.
+  inline VoxelBlock *groupBlock() const { return group_block_; }
+
+  /// Query the byte stride between voxels in @c voxelBytes() for a @c kFGroupAlias block.
+  /// @return The group voxel byte size for an alias or zero when voxels are packed at their natural size.
+  inline unsigned voxelStride() const { return group_stride_; }
+
   /// Retain the uncompressed voxel memory until a corresponding @c release() call. Not recommended; use
   /// @c voxelBuffer().
   ///
-  /// This call may block while the voxel memory is uncompressed or allocated an initialised.
+  /// This call may block while the voxel memory is uncompressed or allocated an initialised. A @c kFUniform block is
+  /// expanded to its fill value. Retaining a block which is already retained only increments the reference count and
+  /// does not lock the @c access_guard_ .
   void retain();
 
   /// Release the uncompressed voxel memory until a corresponding @c release() call. Not recommended; use
   /// @c voxelBuffer().
+  ///
+  /// Only the last release locks the @c access_guard_ , unlocking the block for compression. The last release of a
+  /// @c kFUniformCandidate block returns the block to the @c kFUniform state when all voxels hold the same value.
   void release();
 
+  /// Set hints used by the @c VoxelBlockCompressionQueue to choose which blocks to compress first. See
+  /// @c VoxelBlockCompressionQueue::setPriorityFunction() and @c OccupancyMap::updateCompressionPriority() .
+  ///
+  /// A @c kFGroupAlias block sets the hints of its group block.
+  /// @param distance Distance from the block region to the reference position - generally the sensor position.
+  /// @param protect Set @c kFProtected to compress this block only after all unprotected blocks?
+  void setCompressionHint(float distance, bool protect);
+
+  /// Query the distance set by @c setCompressionHint() . Zero until set.
+  /// @return The distance from the block region to the compression reference position.
+  inline float compressionDistance() const { return compression_distance_; }
+
+  /// Query the time at which the last reference was released, or the construction time if never retained. Used for
+  /// least recently used compression.
+  /// @return The last release time.
+  inline Clock::time_point lastReleaseTime() const { return Clock::time_point(Clock::duration(last_release_)); }
+
+  /// Ensure the uncompressed voxel memory is available without retaining it. This decompresses a compressed block or
+  /// loads a @c kFDeferred block so a subsequent @c retain() need not. Does nothing for uncompressed or @c kFUniform
+  /// blocks.
+  ///
+  /// The block remains eligible for compression, so the memory may be compressed again before it is retained under
+  /// high memory pressure. Generally called from the compression queue - see
+  /// @c VoxelBlockCompressionQueue::prefetch() .
+  void prefetch();
+
+  /// Reset all voxels to the layer clear value, reusing the existing voxel memory where possible. Used to recycle a
+  /// region in place. Must not be called while the block is retained.
+  ///
+  /// A block of a map with @c MapFlag::kUniformBlocks returns to the empty @c kFUniform state.
+  void reset();
+
+  /// Copy the voxel content of @p other into this block as stored, without uncompressing or recompressing. Compressed
+  /// data retain the compression type and dictionary of @p other and uniform blocks remain uniform.
+  ///
+  /// Compressed data are immutable, so they are shared by reference rather than copied. Each block makes its own
+  /// uncompressed copy when first retained.
+  ///
+  /// Both blocks must represent layers with the same voxel layout. Fails if this block is retained, the uncompressed
+  /// sizes differ or either block is a @c kFGroupAlias .
+  /// @param other The block to copy from.
+  /// @return True on success.
+  bool copyFrom(const VoxelBlock &other);
+
+  /// Query if this block shares its compressed data with @p other , as set up by @c copyFrom() .
+  /// @param other The block to compare with.
+  /// @return True if both blocks are compressed and reference the same compressed data.
+  bool sharesCompressedBytes(const VoxelBlock &other) const;
+
+  /// Copy the compressed voxel bytes as stored, without uncompressing. Only succeeds when the block currently holds
+  /// compressed data which can be decoded without a @c CompressionControls::dictionary .
+  /// @param[out] compressed_bytes Set to the compressed voxel bytes on success.
+  /// @param[out] compression_type Set to the @c CompressionType of the @p compressed_bytes on success.
+  /// @return True when the block holds compressed data and @p compressed_bytes have been set.
+  bool compressedBytes(std::vector<uint8_t> &compressed_bytes, CompressionType *compression_type) const;
+
+  /// Defer loading the voxel data until the first @c retain() , when the @p loader is invoked to populate the voxel
+  /// memory. Any current voxel data are discarded. The @p loader is released once invoked, or on @c reset() .
+  ///
+  /// Fails if this block is retained or is a @c kFGroupAlias .
+  /// @param loader The function used to load the voxel data.
+  /// @return True on success.
+  bool setDeferredLoader(DeferredLoader loader);
+
 #if 0
   // This function could be useful, but I'm not keen on maintaining it.
 
@@ -226,37 +380,63 @@ private:
   ///   though the capacity may be larger.
   /// @return True if compressio into @p compression_buffer succeeded.
   bool compressUnguarded(std::vector<uint8_t> &compression_buffer);
+  /// Make the uncompressed voxel memory available: decompress, load a @c kFDeferred block or expand a @c kFUniform
+  /// block. Requires the @c access_guard_ be locked and @c kFUncompressed to be clear.
+  void uncompressForAccessUnguarded();
+
   /// Decompress voxel data into @p expanded_buffer without locking the mutex. This is called from @c retain() after
   /// the mutex is locked.
   /// @param expanded_buffer The buffer to populate with uncompressed data.
   /// @return True on successfully decompressing.
-  bool uncompressUnguarded(std::vector<uint8_t> &expanded_buffer);
+  bool uncompressUnguarded(VoxelBytes &expanded_buffer);
+  /// Release the voxel memory, returning to the @c kFUniform state if all voxels hold the same value. Clears
+  /// @c kFUniformCandidate . Called from @c release() with the mutex locked and a zero reference count.
+  /// @return True if the block is now uniform.
+  bool collapseUniformUnguarded();
   /// Initialise the given buffer to uncompressed voxel data. The voxel data is cleared to the appropriate pattern
   /// for the voxel layer.
   /// @param expanded_buffer The buffer to initialised.
   /// @param layer The layer used to initialise the memory. Must be explicitly passed to handle map layout changes.
-  void initUncompressed(std::vector<uint8_t> &expanded_buffer, const MapLayer &layer);
+  void initUncompressed(VoxelBytes &expanded_buffer, const MapLayer &layer);
   /// Swap the voxel bytes with the given compressed voxel bytes, but only if there are currently no retained
   /// references. This is for use byte the @c VoxelBlockCompressionQueue.
   /// @param compressed_voxels The compressed voxel data.
   /// @return The compressed byte size on success, zero on failure or inability to compress.
   void setCompressedBytesUnguarded(const std::vector<uint8_t> &compressed_voxels);
 
+  /// Return the @c voxel_bytes_ memory to the @c memory_pool_ when it is a full, uncompressed buffer, otherwise free
+  /// it. Leaves @c voxel_bytes_ empty.
+  void recycleVoxelBytesUnguarded();
+
+  /// Report changes in the uncompressed and compressed memory of this block to the @c memory_accounting_ since the last
+  /// call. Requires the @c access_guard_ be locked or the block be otherwise inaccessible.
+  void updateAccountingUnguarded();
+
   /// Voxel data.
   ///
-  /// This data can be in one of three states:
+  /// This data can be in one of five states:
   /// 1. Empty implying no changes have been made from the default initialised values.
-  /// 2. Uncompressed when not empty and `flags_ & kFUncompressed` set.
-  /// 3. Compressed when not emtpy and `flags_ & kFUncompressed` clear.
-  std::vector<uint8_t> voxel_bytes_;
-  /// Data access mutex
+  /// 2. Uniform when `flags_ & kFUniform` is set. This is either empty for the default initialised values, or holds
+  ///    the value of a single voxel which is repeated for all voxels.
+  /// 3. Uncompressed when not empty and `flags_ & kFUncompressed` set.
+  /// 4. Empty when compressed - see @c compressed_bytes_ .
+  /// 5. Empty when deferred: `flags_ & kFDeferred` set - see @c deferred_loader_ .
+  VoxelBytes voxel_bytes_;
+  /// Compressed voxel data. Set when `flags_ & (kFUncompressed | kFUniform)` is clear. Immutable, so may be shared
+  /// between blocks by @c copyFrom() .
+  std::shared_ptr<const std::vector<uint8_t>> compressed_bytes_;
+  /// Data access mutex. Guards state transitions: uncompressing, compressing and the @c reference_count_ leaving or
+  /// reaching zero.
   mutable Mutex access_guard_;
-  /// Number of oustandting @c retain() calls. Cannot be compressed while no zero.
+  /// Number of oustandting @c retain() calls. Cannot be compressed while no zero. Only changes to or from zero with the
+  /// @c access_guard_ locked, so a non zero count guarantees the block is @c kFLocked and @c kFUncompressed .
   std::atomic_uint32_t reference_count_{ 0 };
   /// Block status @c Flag values.
   std::atomic_uint32_t flags_{ 0 };
-  /// Timepoint after which the block may be compressed.
-  Clock::time_point release_after_;
+  /// Time of the last release as @c Clock ticks. See @c lastReleaseTime() .
+  std::atomic<Clock::rep> last_release_{ 0 };
+  /// Distance hint for the @c VoxelBlockCompressionQueue . See @c setCompressionHint() .
+  std::atomic<float> compression_distance_{ 0.0f };
   /// The owning occupancy map detail.
   const OccupancyMapDetail *map_ = nullptr;
   /// The index into the @c MapLayout represented by this voxel data.
@@ -265,16 +445,38 @@ private:
   size_t uncompressed_byte_size_ = 0;
   /// Byte size of this voxel block when uncompressed.
   size_t compressed_byte_size_ = 0;
+  /// The dictionary used to compress @c voxel_bytes_ , if any. Retained to ensure the block can be decompressed after
+  /// the @c CompressionControls change.
+  std::shared_ptr<const VoxelBlockCompressionDictionary> compressed_dictionary_;
+  /// Pool used to allocate and recycle uncompressed voxel memory. Shared with the map so the block may safely outlive
+  /// the map on the compression thread.
+  std::shared_ptr<VoxelMemoryPool> memory_pool_;
+  /// Memory accounting for the owning map. Shared with the map for the same reasons as the @c memory_pool_ .
+  std::shared_ptr<MapMemoryAccounting> memory_accounting_;
+  /// Uncompressed bytes last reported to the @c memory_accounting_ .
+  size_t accounted_uncompressed_bytes_ = 0;
+  /// Compressed bytes last reported to the @c memory_accounting_ .
+  size_t accounted_compressed_bytes_ = 0;
+  /// The group block for a @c kFGroupAlias block.
+  VoxelBlock *group_block_ = nullptr;
+  /// Byte offset of the member data within each group voxel for a @c kFGroupAlias block.
+  unsigned group_offset_ = 0;
+  /// Byte size of each group voxel for a @c kFGroupAlias block.
+  unsigned group_stride_ = 0;
+  /// The @c CompressionType used to compress @c voxel_bytes_ .
+  uint8_t compressed_type_ = kCompressDeflate;
+  /// Loads the voxel data of a @c kFDeferred block. Shared when copied by @c copyFrom() .
+  std::shared_ptr<const DeferredLoader> deferred_loader_;
 };
 
 inline uint8_t *VoxelBlock::voxelBytes()
 {
-  return voxel_bytes_.data();
+  return (group_block_) ? group_block_->voxelBytes() + group_offset_ : voxel_bytes_.data();
 }
 
 inline const uint8_t *VoxelBlock::voxelBytes() const
 {
-  return voxel_bytes_.data();
+  return (group_block_) ? group_block_->voxelBytes() + group_offset_ : voxel_bytes_.data();
 }
 }  // namespace ohm
 
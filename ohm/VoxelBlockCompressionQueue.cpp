@@ -5,6 +5,7 @@
 // Author: Kazys Stepanas
 #include "VoxelBlockCompressionQueue.h"
 
+#include "MemoryTrack.h"
 #include "VoxelBlock.h"
 
 #include "private/VoxelBlockCompressionQueueDetail.h"
@@ -14,11 +15,35 @@
 #include <algorithm>
 #include <chrono>
 #include <cinttypes>
+#include <cmath>
 #include <iostream>
 
 namespace ohm
 {
 const int kSleepIntervalMs = 50;
+/// Minimum sleep interval between compression cycles, used at maximum eviction pressure.
+const int kMinSleepIntervalMs = 5;
+/// Maximum @c VoxelBlockCompressionQueue::defaultWorkerCount()
+const unsigned kMaxDefaultWorkerCount = 4u;
+
+namespace
+{
+double evictionPressure(uint64_t memory_usage, uint64_t high_tide, uint64_t low_tide)
+{
+  if (memory_usage < high_tide)
+  {
+    return 0.0;
+  }
+
+  const uint64_t tide_range = (high_tide > low_tide) ? high_tide - low_tide : 0u;
+  if (tide_range == 0)
+  {
+    return 1.0;
+  }
+
+  return std::min(1.0, double(memory_usage - high_tide) / double(tide_range));
+}
+}  // namespace
 
 VoxelBlockCompressionQueue &VoxelBlockCompressionQueue::instance()
 {
@@ -30,6 +55,7 @@ VoxelBlockCompressionQueue::VoxelBlockCompressionQueue(bool test_mode)
   : imp_(new VoxelBlockCompressionQueueDetail)
 {
   imp_->test_mode = test_mode;
+  imp_->worker_count = (test_mode) ? 1u : defaultWorkerCount();
 }
 
 VoxelBlockCompressionQueue::~VoxelBlockCompressionQueue()
@@ -39,6 +65,7 @@ VoxelBlockCompressionQueue::~VoxelBlockCompressionQueue()
     std::unique_lock<VoxelBlockCompressionQueueDetail::Mutex> guard(imp_->ref_lock);
     joinCurrentThread();
   }
+  joinWorkers();
 }
 
 void VoxelBlockCompressionQueue::retain()
@@ -98,6 +125,86 @@ uint64_t VoxelBlockCompressionQueue::estimatedAllocationSize() const
 }
 
 
+unsigned VoxelBlockCompressionQueue::workerCount() const
+{
+  return imp_->worker_count;
+}
+
+
+void VoxelBlockCompressionQueue::setWorkerCount(unsigned count)
+{
+  imp_->worker_count = (count > 0) ? count : defaultWorkerCount();
+}
+
+
+unsigned VoxelBlockCompressionQueue::defaultWorkerCount()
+{
+  const unsigned hardware_threads = std::thread::hardware_concurrency();
+  return std::max(1u, std::min(hardware_threads / 4u, kMaxDefaultWorkerCount));
+}
+
+
+void VoxelBlockCompressionQueue::setPriorityPolicy(CompressionPolicy policy)
+{
+  switch (policy)
+  {
+  case CompressionPolicy::kFarthestFirst:
+    setPriorityFunction([](const CompressionCandidate &candidate) { return candidate.distance; });
+    break;
+  case CompressionPolicy::kLeastRecentlyUsed:
+    setPriorityFunction([](const CompressionCandidate &candidate) { return candidate.idle_seconds; });
+    break;
+  case CompressionPolicy::kLargestFirst:
+  default:
+    setPriorityFunction(PriorityFunction());
+    break;
+  }
+}
+
+
+void VoxelBlockCompressionQueue::setPriorityFunction(const PriorityFunction &priority)
+{
+  std::unique_lock<VoxelBlockCompressionQueueDetail::Mutex> guard(imp_->policy_lock);
+  imp_->priority_function = priority;
+}
+
+
+double VoxelBlockCompressionQueue::thrashWindow() const
+{
+  return imp_->thrash_window;
+}
+
+
+void VoxelBlockCompressionQueue::setThrashWindow(double seconds)
+{
+  imp_->thrash_window = seconds;
+}
+
+
+CompressionStatistics VoxelBlockCompressionQueue::statistics() const
+{
+  CompressionStatistics stats;
+  stats.compressed_count = imp_->compressed_count;
+  stats.decompressed_count = imp_->decompressed_count;
+  stats.thrash_count = imp_->thrash_count;
+  return stats;
+}
+
+
+void VoxelBlockCompressionQueue::resetStatistics()
+{
+  imp_->compressed_count = 0;
+  imp_->decompressed_count = 0;
+  imp_->thrash_count = 0;
+}
+
+
+double VoxelBlockCompressionQueue::evictionPressure() const
+{
+  return ohm::evictionPressure(imp_->estimated_allocated_size, imp_->high_tide, imp_->low_tide);
+}
+
+
 void VoxelBlockCompressionQueue::push(VoxelBlock *block)
 {
   if (imp_->running || imp_->test_mode)
@@ -108,6 +215,38 @@ void VoxelBlockCompressionQueue::push(VoxelBlock *block)
 }
 
 
+bool VoxelBlockCompressionQueue::prefetch(VoxelBlock *block)
+{
+  if (!imp_->running && !imp_->test_mode)
+  {
+    return false;
+  }
+
+  if (block->group_block_)
+  {
+    block = block->group_block_;
+  }
+
+  const uint32_t flags = block->flags_;
+  if (!(flags & VoxelBlock::kFManagedForCompression) ||
+      (flags & (VoxelBlock::kFUncompressed | VoxelBlock::kFUniform | VoxelBlock::kFMarkedForDeath)))
+  {
+    return false;
+  }
+
+  if (block->flags_.fetch_or(VoxelBlock::kFPrefetchPending) & VoxelBlock::kFPrefetchPending)
+  {
+    // Already queued.
+    return false;
+  }
+
+  ohm::pushPrefetch(*imp_, block);
+  imp_->prefetch_signalled = true;
+  imp_->wake_signal.notify_one();
+  return true;
+}
+
+
 bool VoxelBlockCompressionQueue::testMode() const
 {
   return imp_->test_mode;
@@ -116,6 +255,10 @@ bool VoxelBlockCompressionQueue::testMode() const
 
 void VoxelBlockCompressionQueue::__tick(std::vector<uint8_t> &compression_buffer)
 {
+  // Service prefetch requests first so the blocks are ready as soon as possible. This also ensures no request remains
+  // queued for a block deleted below.
+  processPrefetches();
+
   // Process any new items added to the compression queue by adding them to the block list.
   {
     VoxelBlock *voxels = nullptr;
@@ -127,19 +270,32 @@ void VoxelBlockCompressionQueue::__tick(std::vector<uint8_t> &compression_buffer
   }
 
   // Estimate the current memory usage and release items marked for death.
+  const auto now = std::chrono::steady_clock::now();
+  const auto thrash_window = std::chrono::duration<double>(imp_->thrash_window.load());
   uint64_t memory_usage = 0;
   const uint64_t high_tide = imp_->high_tide;
   const uint64_t low_tide = imp_->low_tide;
   for (auto iter = imp_->blocks.begin(); iter != imp_->blocks.end();)
   {
     CompressionEntry &entry = *iter;
-    // Check if marked for death.
+    // Check if marked for death. Deletion is deferred while a prefetch request is pending: one may have been pushed
+    // since processPrefetches() ran above.
     if (!(entry.voxels->flags_ & VoxelBlock::kFMarkedForDeath))
     {
       // Still alive. Update th entry's allocation size.
       if (entry.voxels->flags_ & VoxelBlock::kFUncompressed)
       {
         entry.allocation_size = entry.voxels->uncompressed_byte_size_;
+        if (entry.queue_compressed)
+        {
+          // Decompressed since we compressed it.
+          entry.queue_compressed = false;
+          ++imp_->decompressed_count;
+          if (now - entry.compressed_time < thrash_window)
+          {
+            ++imp_->thrash_count;
+          }
+        }
       }
       else
       {
@@ -149,6 +305,11 @@ void VoxelBlockCompressionQueue::__tick(std::vector<uint8_t> &compression_buffer
       memory_usage += entry.allocation_size;
       ++iter;
     }
+    else if (entry.voxels->flags_ & VoxelBlock::kFPrefetchPending)
+    {
+      // Delete on a later tick.
+      ++iter;
+    }
     else
     {
       // Marked for death. Remove this entry;
@@ -165,54 +326,77 @@ void VoxelBlockCompressionQueue::__tick(std::vector<uint8_t> &compression_buffer
   // Check if we are over the high tide and release what we can.
   if (memory_usage >= high_tide)
   {
-    // Sort all blocks by allocation size.
-    // TODO(KS): consider including the queued for compression flag so we push items to be compressed to the front
-    // of the sort results.
+    // Sort all blocks by priority with protected blocks last. The default priority is the allocation size.
     // TODO(KS): try using a partial sort.
-    std::sort(imp_->blocks.begin(), imp_->blocks.end(), [](const CompressionEntry &a, const CompressionEntry &b) {
-      return a.allocation_size > b.allocation_size;
-    });
-
-    auto iter = imp_->blocks.begin();
-    // Free until we reach the low tide.
-    while (iter != imp_->blocks.end() && memory_usage >= low_tide)
+    PriorityFunction priority;
     {
-      // Check if marked for death. The status may have changed since we updated the allocation size.
-      if (!(iter->voxels->flags_ & VoxelBlock::kFMarkedForDeath))
+      std::unique_lock<VoxelBlockCompressionQueueDetail::Mutex> guard(imp_->policy_lock);
+      priority = imp_->priority_function;
+    }
+    CompressionCandidate candidate;
+    for (CompressionEntry &entry : imp_->blocks)
+    {
+      entry.protect = (entry.voxels->flags_ & VoxelBlock::kFProtected) != 0;
+      if (priority)
       {
-        // Not maked for death. Check lock flag and compress this item if we can
-        if (!(iter->voxels->flags_ & VoxelBlock::kFLocked))
-        {
-          // Block is not locked.
-          logutil::trace("compress\n");
-          // Try compress the current item. This could fail as the flag can have changed. On failure, the
-          // compressed_size will be zero. We call compressWithTemporaryBuffer() to re-use the compression buffer
-          // memory.
-          size_t compressed_size = iter->voxels->compressWithTemporaryBuffer(compression_buffer);
-          if (compressed_size)
-          {
-            // Compression succeeded.
-            // Adjust memory_usage down in a way which guarantees no underflow. Paranoia.
-            memory_usage = (memory_usage > iter->allocation_size) ? memory_usage - iter->allocation_size : 0u;
-            memory_usage += compressed_size;
-          }
-        }
-
-        ++iter;
+        candidate.allocation_size = entry.allocation_size;
+        candidate.distance = entry.voxels->compressionDistance();
+        candidate.idle_seconds = std::chrono::duration<double>(now - entry.voxels->lastReleaseTime()).count();
+        entry.priority = priority(candidate);
       }
       else
       {
-        // Block no longer required. Remove it.
-        // Marked for death. Clean it up.
-        // Lock access guard to make sure the code that sets the flag has completed
-        iter->voxels->access_guard_.lock();
-        // fprintf(stderr, "0x%" PRIXPTR ", VoxelBlockCompressionQueue\n", (uintptr_t)iter->voxels);
-        delete iter->voxels;
-        // Adjust memory_usage down in a way which guarantees no underflow. Paranoia.
-        memory_usage = (memory_usage > iter->allocation_size) ? memory_usage - iter->allocation_size : 0u;
-        iter = imp_->blocks.erase(iter);
+        entry.priority = double(entry.allocation_size);
+      }
+    }
+    std::sort(imp_->blocks.begin(), imp_->blocks.end(), [](const CompressionEntry &a, const CompressionEntry &b) {
+      if (a.protect != b.protect)
+      {
+        return b.protect;
+      }
+      return a.priority > b.priority;
+    });
+
+    // Engage more workers the further we are over the high tide.
+    const double pressure = ohm::evictionPressure(memory_usage, high_tide, low_tide);
+    const unsigned worker_count = std::max(1u, imp_->worker_count.load());
+    const unsigned pool_workers = unsigned(std::lround(pressure * double(worker_count - 1)));
+
+    CompressionJob &job = imp_->job;
+    job.cursor = 0;
+    job.end = imp_->blocks.size();
+    job.memory_usage = memory_usage;
+    job.low_tide = low_tide;
+    job.freed = 0;
+
+    if (pool_workers)
+    {
+      while (imp_->workers.size() < pool_workers)
+      {
+        const auto worker_index = unsigned(imp_->workers.size());
+        const unsigned job_id = job.job_id;
+        imp_->workers.emplace_back([this, worker_index, job_id]() { this->workerRun(worker_index, job_id); });
       }
+
+      std::unique_lock<std::mutex> guard(job.lock);
+      job.requested_workers = job.busy_workers = pool_workers;
+      ++job.job_id;
+      guard.unlock();
+      job.start_signal.notify_all();
+    }
+
+    // Free until we reach the low tide. This thread also does its share of the work.
+    processJob(compression_buffer);
+
+    if (pool_workers)
+    {
+      std::unique_lock<std::mutex> guard(job.lock);
+      job.done_signal.wait(guard, [&job]() { return job.busy_workers == 0; });
     }
+
+    // Adjust memory_usage down in a way which guarantees no underflow. Paranoia.
+    const uint64_t freed = job.freed;
+    memory_usage = (memory_usage > freed) ? memory_usage - freed : 0u;
   }
 
   imp_->estimated_allocated_size = memory_usage;
@@ -224,7 +408,11 @@ void VoxelBlockCompressionQueue::joinCurrentThread()
   if (imp_->running)
   {
     imp_->quit_flag = true;
+    imp_->wake_signal.notify_one();
     imp_->processing_thread.join();
+    joinWorkers();
+    // Drop any outstanding requests.
+    processPrefetches();
     // Clear the running and quit flags.
     imp_->running = false;
     imp_->quit_flag = false;
@@ -232,13 +420,131 @@ void VoxelBlockCompressionQueue::joinCurrentThread()
 }
 
 
+void VoxelBlockCompressionQueue::processPrefetches()
+{
+  imp_->prefetch_signalled = false;
+  VoxelBlock *block = nullptr;
+  while (ohm::tryPopPrefetch(*imp_, &block))
+  {
+    if (!(block->flags_ & VoxelBlock::kFMarkedForDeath))
+    {
+      block->prefetch();
+    }
+    // The block may be deleted once this flag is cleared.
+    block->flags_ &= ~VoxelBlock::kFPrefetchPending;
+  }
+}
+
+
+void VoxelBlockCompressionQueue::joinWorkers()
+{
+  CompressionJob &job = imp_->job;
+  {
+    std::unique_lock<std::mutex> guard(job.lock);
+    job.quit = true;
+  }
+  job.start_signal.notify_all();
+  for (auto &worker : imp_->workers)
+  {
+    worker.join();
+  }
+  imp_->workers.clear();
+  job.quit = false;
+}
+
+
+void VoxelBlockCompressionQueue::workerRun(unsigned worker_index, unsigned last_job_id)
+{
+  std::vector<uint8_t> compression_buffer;
+  memorytrack::BufferTracker buffer_track(MemorySubsystem::kCompression);
+  CompressionJob &job = imp_->job;
+  std::unique_lock<std::mutex> guard(job.lock);
+  while (true)
+  {
+    job.start_signal.wait(guard, [&job, last_job_id]() { return job.quit || job.job_id != last_job_id; });
+    if (job.quit)
+    {
+      break;
+    }
+
+    last_job_id = job.job_id;
+    if (worker_index >= job.requested_workers)
+    {
+      continue;
+    }
+
+    guard.unlock();
+    processJob(compression_buffer);
+    buffer_track.track(compression_buffer);
+    guard.lock();
+
+    if (--job.busy_workers == 0)
+    {
+      job.done_signal.notify_all();
+    }
+  }
+}
+
+
+void VoxelBlockCompressionQueue::processJob(std::vector<uint8_t> &compression_buffer)
+{
+  CompressionJob &job = imp_->job;
+  while (true)
+  {
+    // Stop once we reach the low tide.
+    const uint64_t freed = job.freed;
+    const uint64_t memory_usage = (job.memory_usage > freed) ? job.memory_usage - freed : 0u;
+    if (memory_usage < job.low_tide)
+    {
+      break;
+    }
+
+    const size_t index = job.cursor++;
+    if (index >= job.end)
+    {
+      break;
+    }
+
+    // Each index is visited by one worker, so the entry may be modified.
+    CompressionEntry &entry = imp_->blocks[index];
+    // Check if marked for death or locked. The status may have changed since we updated the allocation size. Blocks
+    // marked for death are released on the next tick.
+    if (!(entry.voxels->flags_ & (VoxelBlock::kFMarkedForDeath | VoxelBlock::kFLocked)))
+    {
+      logutil::trace("compress\n");
+      // Try compress the current item. This could fail as the flag can have changed. On failure, the
+      // compressed_size will be zero. We call compressWithTemporaryBuffer() to re-use the compression buffer
+      // memory.
+      const size_t compressed_size = entry.voxels->compressWithTemporaryBuffer(compression_buffer);
+      if (compressed_size && compressed_size < entry.allocation_size)
+      {
+        job.freed += entry.allocation_size - compressed_size;
+        entry.queue_compressed = true;
+        entry.compressed_time = std::chrono::steady_clock::now();
+        ++imp_->compressed_count;
+      }
+    }
+  }
+}
+
+
 void VoxelBlockCompressionQueue::run()
 {
   std::vector<uint8_t> compression_buffer;
+  memorytrack::BufferTracker buffer_track(MemorySubsystem::kCompression);
   while (!imp_->quit_flag)
   {
-    std::this_thread::sleep_for(std::chrono::milliseconds(kSleepIntervalMs));
+    // Tick more frequently under eviction pressure.
+    const double pressure = evictionPressure();
+    const auto sleep_ms = int(kSleepIntervalMs - pressure * (kSleepIntervalMs - kMinSleepIntervalMs));
+    {
+      // Wake early for prefetch requests.
+      std::unique_lock<std::mutex> guard(imp_->wake_lock);
+      imp_->wake_signal.wait_for(guard, std::chrono::milliseconds(sleep_ms),
+                                 [this]() { return imp_->quit_flag || imp_->prefetch_signalled; });
+    }
     __tick(compression_buffer);
+    buffer_track.track(compression_buffer);
   }
 }
 }  // namespace ohm
@@ -8,6 +8,9 @@
 
 #include "OhmConfig.h"
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 
 namespace ohm
@@ -15,6 +18,41 @@ namespace ohm
 class VoxelBlock;
 struct VoxelBlockCompressionQueueDetail;
 
+/// Built in compression priority policies for the @c VoxelBlockCompressionQueue .
+enum class CompressionPolicy : int
+{
+  /// Compress the largest blocks first. This frees memory fastest and is the default.
+  kLargestFirst,
+  /// Compress the blocks farthest from the reference position first - see @c VoxelBlock::compressionDistance() .
+  kFarthestFirst,
+  /// Compress the blocks which have been released the longest first - see @c VoxelBlock::lastReleaseTime() .
+  kLeastRecentlyUsed
+};
+
+/// Describes a block which may be compressed for a @c VoxelBlockCompressionQueue::PriorityFunction .
+struct ohm_API CompressionCandidate
+{
+  /// Current allocation size of the block (bytes).
+  size_t allocation_size = 0;
+  /// Distance from the block region to the compression reference position. See
+  /// @c VoxelBlock::compressionDistance() .
+  double distance = 0;
+  /// Seconds since the block was last released.
+  double idle_seconds = 0;
+};
+
+/// Statistics used to assess how well the compression policy avoids thrashing. See
+/// @c VoxelBlockCompressionQueue::statistics() .
+struct ohm_API CompressionStatistics
+{
+  /// Number of blocks compressed by the queue.
+  uint64_t compressed_count = 0;
+  /// Number of blocks compressed by the queue which were later decompressed.
+  uint64_t decompressed_count = 0;
+  /// Number of blocks decompressed within the @c VoxelBlockCompressionQueue::thrashWindow() of being compressed.
+  uint64_t thrash_count = 0;
+};
+
 /// Background compression thread used to manage compression of @c VoxelBlock data.
 ///
 /// The queue supports reference counting in order to allow a single queue to be used accross multiple maps.
@@ -22,9 +60,22 @@ struct VoxelBlockCompressionQueueDetail;
 /// last reference then attaining a new reference to start a new background thread.
 ///
 /// An @c OccupancyMap will call @c retain() and @c release() on construction and destruction respectively.
+///
+/// Compression starts once the @c estimatedAllocationSize() exceeds the @c highTide() and continues until the
+/// @c lowTide() is reached. Blocks may be compressed by a pool of worker threads - see @c setWorkerCount() . The
+/// number of workers engaged and the frequency of the compression cycle scale with the @c evictionPressure() ; that is,
+/// with how far the allocation is above the high tide.
+///
+/// The order in which blocks are compressed is set by the @c setPriorityPolicy() or a custom
+/// @c setPriorityFunction() . Blocks flagged @c VoxelBlock::kFProtected - such as those near the sensor, see
+/// @c OccupancyMap::updateCompressionPriority() - are only compressed after all other blocks, regardless of policy.
+/// Use the @c statistics() to see how often compressed blocks are soon decompressed again.
 class ohm_API VoxelBlockCompressionQueue
 {
 public:
+  /// Function used to prioritise blocks for compression. Blocks with a higher priority are compressed first.
+  using PriorityFunction = std::function<double(const CompressionCandidate &)>;
+
   /// Singleton access.
   static VoxelBlockCompressionQueue &instance();
 
@@ -57,10 +108,68 @@ public:
   /// Query the number of bytes allocated to voxel blocks managed by this compressor (byte).
   uint64_t estimatedAllocationSize() const;
 
+  /// Query the maximum number of threads used to compress voxel blocks. This includes the background management
+  /// thread.
+  /// @return The compression worker count.
+  unsigned workerCount() const;
+  /// Set the maximum number of threads used to compress voxel blocks. Additional worker threads are started as
+  /// required.
+  ///
+  /// Note that multiple workers may compress beyond the @c lowTide() by up to one block per worker as workers run
+  /// concurrently.
+  /// @param count The number of workers. Zero selects the @c defaultWorkerCount() .
+  void setWorkerCount(unsigned count);
+  /// Query the default @c workerCount() , which is based on the hardware concurrency. Test mode queues default to
+  /// a single worker.
+  /// @return The default worker count.
+  static unsigned defaultWorkerCount();
+
+  /// Query the current eviction pressure in the range [0, 1]. This is zero when the @c estimatedAllocationSize() is
+  /// below the @c highTide() and rises to 1 as the allocation exceeds the high tide by the tide range: the
+  /// difference between the high and low tides.
+  /// @return The current eviction pressure.
+  double evictionPressure() const;
+
+  /// Select a built in compression priority policy. This replaces any @c setPriorityFunction() .
+  /// @param policy The policy to use.
+  void setPriorityPolicy(CompressionPolicy policy);
+
+  /// Set a custom compression priority function.
+  /// @param priority The function to use. An empty function selects @c CompressionPolicy::kLargestFirst .
+  void setPriorityFunction(const PriorityFunction &priority);
+
+  /// Query the time window within which decompressing a block after compression counts towards the
+  /// @c CompressionStatistics::thrash_count .
+  /// @return The thrash window (seconds).
+  double thrashWindow() const;
+  /// Set the @c thrashWindow() .
+  /// @param seconds The thrash window (seconds).
+  void setThrashWindow(double seconds);
+
+  /// Query the compression statistics since construction or the last @c resetStatistics() . Decompression is
+  /// detected on each compression cycle, so the decompression counts lag by up to one cycle.
+  /// @return The compression statistics.
+  CompressionStatistics statistics() const;
+  /// Reset the @c statistics() .
+  void resetStatistics();
+
   /// Push a @c VoxelBlock on the queue for compression.
   /// @param block The block to compress.
   void push(VoxelBlock *block);
 
+  /// Request asynchronous decompression of a @c VoxelBlock ahead of its next @c VoxelBlock::retain() . This avoids
+  /// stalling the retaining thread when revisiting compressed regions. Requests are serviced by the background
+  /// thread, which is woken early to do so, before each compression cycle. See @c VoxelBlock::prefetch() .
+  ///
+  /// Only blocks managed by this queue are accepted. A block which is already uncompressed, uniform or queued for
+  /// prefetch is ignored. A queued block may be destroyed before the request is serviced, in which case the request
+  /// is dropped.
+  ///
+  /// In @c testMode() , requests are serviced by the next @c __tick() call.
+  /// @param block The block to decompress. A @c VoxelBlock::kFGroupAlias resolves to its group block.
+  /// @return True if the block has been queued for prefetch.
+  bool prefetch(VoxelBlock *block);
+
   /// True if this object has been created in test mode.
   bool testMode() const;
 
@@ -71,6 +180,22 @@ public:
 private:
   void joinCurrentThread();
 
+  /// Service all queued @c prefetch() requests.
+  void processPrefetches();
+
+  /// Stop and join the compression @c workers .
+  void joinWorkers();
+
+  /// Compression worker thread entry point.
+  /// @param worker_index Index of the worker in the pool. Only workers with an index below the
+  ///   @c CompressionJob::requested_workers participate in a job.
+  /// @param last_job_id The @c CompressionJob::job_id when the worker is created. The worker waits for the next job.
+  void workerRun(unsigned worker_index, unsigned last_job_id);
+
+  /// Compress blocks from the current @c CompressionJob until the job is complete or the low tide is reached.
+  /// @param compression_buffer Buffer used to compress into.
+  void processJob(std::vector<uint8_t> &compression_buffer);
+
   /// Main compression loop. This is the thread entry point.
   void run();
 
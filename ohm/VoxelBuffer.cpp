@@ -15,6 +15,7 @@ VoxelBuffer<VoxelBlock>::VoxelBuffer(ohm::VoxelBlock *block)
   {
     block->retain();
     voxel_memory_size_ = block->uncompressedByteSize();
+    voxel_stride_ = block->voxelStride();
     voxel_memory_ = block->voxelBytes();
   }
 }
@@ -23,6 +24,7 @@ template <typename VoxelBlock>
 VoxelBuffer<VoxelBlock>::VoxelBuffer(VoxelBuffer<VoxelBlock> &&other) noexcept
   : voxel_memory_(std::exchange(other.voxel_memory_, nullptr))
   , voxel_memory_size_(std::exchange(other.voxel_memory_size_, 0))
+  , voxel_stride_(std::exchange(other.voxel_stride_, 0))
   , voxel_block_(std::exchange(other.voxel_block_, nullptr))
 {}
 
@@ -30,6 +32,7 @@ template <typename VoxelBlock>
 VoxelBuffer<VoxelBlock>::VoxelBuffer(const VoxelBuffer<VoxelBlock> &other)
   : voxel_memory_(other.voxel_memory_)
   , voxel_memory_size_(other.voxel_memory_size_)
+  , voxel_stride_(other.voxel_stride_)
   , voxel_block_(other.voxel_block_)
 {
   if (voxel_block_)
@@ -49,6 +52,7 @@ VoxelBuffer<VoxelBlock> &VoxelBuffer<VoxelBlock>::operator=(VoxelBuffer<VoxelBlo
 {
   std::swap(voxel_block_, other.voxel_block_);
   std::swap(voxel_memory_size_, other.voxel_memory_size_);
+  std::swap(voxel_stride_, other.voxel_stride_);
   std::swap(voxel_memory_, other.voxel_memory_);
   return *this;
 }
@@ -64,6 +68,7 @@ VoxelBuffer<VoxelBlock> &VoxelBuffer<VoxelBlock>::operator=(const VoxelBuffer<Vo
     {
       voxel_block_->retain();
       voxel_memory_size_ = voxel_block_->uncompressedByteSize();
+      voxel_stride_ = voxel_block_->voxelStride();
       voxel_memory_ = voxel_block_->voxelBytes();
     }
   }
@@ -79,6 +84,7 @@ void VoxelBuffer<VoxelBlock>::release()
     voxel_block_ = nullptr;
     voxel_memory_ = nullptr;
     voxel_memory_size_ = 0;
+    voxel_stride_ = 0;
   }
 }
 
@@ -75,6 +75,10 @@ public:
   /// Access the wrapped @c VoxelBlock pointer.
   /// @return The wrapped object pointer.
   VoxelBlock *voxelBlock() const { return voxel_block_; }
+  /// Query the byte stride between voxels in the @c voxelMemory() . This differs from the voxel size for
+  /// @c MapLayer::kGroupMember layers. See @c VoxelBlock::voxelStride() .
+  /// @return The voxel byte stride or zero when voxels are packed at their natural size.
+  size_t voxelStride() const { return voxel_stride_; }
 
   /// Read the content for a voxel in the buffer. Must only be called if @c isValid() , @c voxel_index is in range
   /// and @c T is the contained data type, exactly matching the voxel data size.
@@ -82,9 +86,9 @@ public:
   /// @param[out] value The voxel content is written to this address.
   /// @tparam T The data type to read. Must exactly match the voxel size and content for the referenced voxel layer.
   template <typename T>
-  void readVoxel(unsigned voxel_index, T *value)
+  void readVoxel(unsigned voxel_index, T *value) const
   {
-    memcpy(value, voxelMemory() + sizeof(T) * voxel_index, sizeof(T));
+    memcpy(value, voxelMemory() + ((voxel_stride_) ? voxel_stride_ : sizeof(T)) * voxel_index, sizeof(T));
   }
 
   /// Write the content for a voxel in the buffer. Must only be called if @c isValid() , @c voxel_index is in range
@@ -95,7 +99,7 @@ public:
   template <typename T>
   void writeVoxel(unsigned voxel_index, const T &value)
   {
-    memcpy(voxelMemory() + sizeof(T) * voxel_index, &value, sizeof(T));
+    memcpy(voxelMemory() + ((voxel_stride_) ? voxel_stride_ : sizeof(T)) * voxel_index, &value, sizeof(T));
   }
 
   /// Explicitly release the buffer. Further usage is invalid and @c isValid() will return `false`.
@@ -104,6 +108,7 @@ public:
 protected:
   VoxelPtr voxel_memory_{ nullptr };         ///< Pointer to the uncompressed voxel memory.
   size_t voxel_memory_size_{ 0 };            ///< Number of bytes referenced by the @c voxel_memory_ .
+  size_t voxel_stride_{ 0 };                 ///< Voxel byte stride for group members, zero when packed.
   ohm::VoxelBlock *voxel_block_{ nullptr };  ///< The @c VoxelBlock object owning the voxel memory.
 };
 
@@ -0,0 +1,32 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELCLEARANCECHANNELS_H
+#define OHM_VOXELCLEARANCECHANNELS_H
+
+#include "OhmConfig.h"
+
+namespace ohm
+{
+/// Voxel data for the clearance channels layer - see @c addClearanceChannels() .
+///
+/// The clearance channels complement the omnidirectional @c MapLayout::clearanceLayer() value with directional
+/// clearance values suited to ground robot footprints. Both channels are calculated with the clearance layer, using
+/// the same search radius.
+///
+/// Each channel should be interpreted as for the clearance layer:
+/// - 0 => The voxel is itself an obstruction.
+/// - > 0 => The range to the nearest obstruction for that channel, within the search radius.
+/// - < 0 => There are no obstructions for that channel within the search radius.
+struct VoxelClearanceChannels
+{
+  /// Range to the nearest obstruction in the voxel's XY plane - the same voxel layer in Z.
+  float horizontal;
+  /// Height to the nearest obstruction directly above the voxel - the same voxel column in X and Y.
+  float overhead;
+};
+}  // namespace ohm
+
+#endif  // OHM_VOXELCLEARANCECHANNELS_H
@@ -0,0 +1,56 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELESDF_H
+#define OHM_VOXELESDF_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <cinttypes>
+
+namespace ohm
+{
+/// Voxel data for the Euclidean distance field layer maintained by an @c EsdfProcess .
+///
+/// Each voxel stores the distance to its nearest obstacle voxel along with the voxel offset to that obstacle. The
+/// offset allows the distance field to be incrementally repaired when obstacles are removed: only voxels whose
+/// nearest obstacle is no longer an obstacle need be invalidated.
+///
+/// The @c distance should be interpreted as follows:
+/// - 0 => The voxel is itself an obstacle.
+/// - > 0 => The distance from the voxel centre to nearest known obstacle voxel centre.
+/// - < 0 => There are no known obstacles within the @c EsdfProcess::maxDistance() .
+struct VoxelEsdf
+{
+  /// Distance to the nearest obstacle voxel. Negative when there is no known obstacle.
+  float distance;
+  /// Voxel offset along X from this voxel to the nearest obstacle voxel. Only valid when @c distance is not negative.
+  int32_t obstacle_x;
+  /// Voxel offset along Y from this voxel to the nearest obstacle voxel. Only valid when @c distance is not negative.
+  int32_t obstacle_y;
+  /// Voxel offset along Z from this voxel to the nearest obstacle voxel. Only valid when @c distance is not negative.
+  int32_t obstacle_z;
+};
+
+/// Query if @p voxel has a known obstacle within range.
+/// @param voxel The voxel to query.
+/// @return True if the @c VoxelEsdf::distance is valid.
+inline bool esdfHasObstacle(const VoxelEsdf &voxel)
+{
+  return voxel.distance >= 0;
+}
+
+/// Extract the voxel offset to the nearest obstacle from @p voxel .
+/// @param voxel The voxel to query. Must satisfy @c esdfHasObstacle() .
+/// @return The voxel offset to the nearest obstacle.
+inline glm::ivec3 esdfObstacleOffset(const VoxelEsdf &voxel)
+{
+  return glm::ivec3(voxel.obstacle_x, voxel.obstacle_y, voxel.obstacle_z);
+}
+}  // namespace ohm
+
+#endif  // OHM_VOXELESDF_H
@@ -0,0 +1,176 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "VoxelMean.h"
+
+#include "OccupancyMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace ohm
+{
+namespace
+{
+/// Number of voxels committed per batch in @c updatePositionsSorted() .
+const size_t kMeanBatchSize = 256;
+/// Quantisation bits per axis. Must match @c subVoxelCoord() .
+const unsigned kMeanBitsPerAxis = 10;
+/// Maximum quantised value per axis.
+const int kMeanPositions = (1 << kMeanBitsPerAxis) - 1;  // NOLINT(hicpp-signed-bitwise)
+/// Bit marking a voxel mean pattern as used.
+const unsigned kMeanUsedBit = (1u << 31u);
+
+inline unsigned quantiseMeanAxis(double coord, double mean_resolution)
+{
+  // Equivalent to pointToRegionCoord() followed by clamping to [0, kMeanPositions]. Written without branches to
+  // support vectorisation.
+  const int pos = int(std::floor(coord / mean_resolution + 0.5));
+  return unsigned(std::max(0, std::min(pos, kMeanPositions)));
+}
+
+/// Commit the accumulated samples for a batch of voxels.
+void commitMeanBatch(Voxel<VoxelMean> &mean_voxel, const std::vector<Key> &keys,
+                     const std::vector<VoxelMeanAccumulator> &accumulators, std::vector<VoxelMean> &means,
+                     std::vector<glm::dvec3> &local_coords, std::vector<unsigned> &patterns)
+{
+  const OccupancyMap &map = *mean_voxel.map();
+  const double resolution = map.resolution();
+  const size_t count = keys.size();
+  means.resize(count);
+  local_coords.resize(count);
+  patterns.resize(count);
+
+  // Gather the current patterns.
+  for (size_t i = 0; i < count; ++i)
+  {
+    mean_voxel.setKey(keys[i]);
+    mean_voxel.read(&means[i]);
+    patterns[i] = means[i].coord;
+  }
+
+  subVoxelToLocalCoordBatch(patterns.data(), count, resolution, local_coords.data());
+
+  // Combine with the accumulated samples.
+  for (size_t i = 0; i < count; ++i)
+  {
+    const double existing_weight = double(means[i].count);
+    const double total = existing_weight + double(accumulators[i].count);
+    local_coords[i] = (local_coords[i] * existing_weight + accumulators[i].local_sum) / total;
+  }
+
+  subVoxelCoordBatch(local_coords.data(), count, resolution, patterns.data());
+
+  // Scatter the results.
+  for (size_t i = 0; i < count; ++i)
+  {
+    means[i].coord = patterns[i];
+    means[i].count = unsigned(std::min<uint64_t>(uint64_t(means[i].count) + accumulators[i].count,
+                                                 std::numeric_limits<unsigned>::max()));
+    mean_voxel.setKey(keys[i]);
+    mean_voxel.write(means[i]);
+  }
+}
+}  // namespace
+
+void subVoxelCoordBatch(const glm::dvec3 *voxel_local_coords, size_t count, double resolution, unsigned *patterns)
+{
+  const double mean_resolution = resolution / double(kMeanPositions);
+  const double offset = 0.5 * resolution;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const unsigned pos_x = quantiseMeanAxis(voxel_local_coords[i].x + offset, mean_resolution);
+    const unsigned pos_y = quantiseMeanAxis(voxel_local_coords[i].y + offset, mean_resolution);
+    const unsigned pos_z = quantiseMeanAxis(voxel_local_coords[i].z + offset, mean_resolution);
+    patterns[i] = pos_x | (pos_y << kMeanBitsPerAxis) | (pos_z << (2 * kMeanBitsPerAxis)) | kMeanUsedBit;
+  }
+}
+
+
+void subVoxelToLocalCoordBatch(const unsigned *patterns, size_t count, double resolution,
+                               glm::dvec3 *voxel_local_coords)
+{
+  const double mean_resolution = resolution / double(kMeanPositions);
+  const double offset = 0.5 * resolution;
+  const unsigned mask = unsigned(kMeanPositions);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const unsigned pattern = patterns[i];
+    voxel_local_coords[i].x = double(pattern & mask) * mean_resolution - offset;
+    voxel_local_coords[i].y = double((pattern >> kMeanBitsPerAxis) & mask) * mean_resolution - offset;
+    voxel_local_coords[i].z = double((pattern >> (2 * kMeanBitsPerAxis)) & mask) * mean_resolution - offset;
+  }
+}
+
+
+size_t updatePositionsSorted(OccupancyMap &map, const Key *keys, const glm::dvec3 *samples, size_t count)
+{
+  Voxel<VoxelMean> mean_voxel(&map, map.layout().meanLayer());
+  if (!mean_voxel.isLayerValid())
+  {
+    return 0;
+  }
+
+  std::vector<Key> batch_keys;
+  std::vector<VoxelMeanAccumulator> accumulators;
+  std::vector<VoxelMean> means;
+  std::vector<glm::dvec3> local_coords;
+  std::vector<unsigned> patterns;
+  batch_keys.reserve(kMeanBatchSize);
+  accumulators.reserve(kMeanBatchSize);
+
+  size_t updated_count = 0;
+  size_t i = 0;
+  while (i < count)
+  {
+    const Key key = keys[i];
+    if (key.isNull())
+    {
+      ++i;
+      continue;
+    }
+
+    // Accumulate the run of samples in this voxel.
+    const glm::dvec3 voxel_centre = map.voxelCentreGlobal(key);
+    VoxelMeanAccumulator accumulator;
+    for (; i < count && keys[i] == key; ++i)
+    {
+      accumulator.add(samples[i], voxel_centre);
+    }
+
+    // A repeated run for a voxel already in the batch would read a stale value. Commit the batch first.
+    if (std::find(batch_keys.begin(), batch_keys.end(), key) != batch_keys.end())
+    {
+      commitMeanBatch(mean_voxel, batch_keys, accumulators, means, local_coords, patterns);
+      updated_count += batch_keys.size();
+      batch_keys.clear();
+      accumulators.clear();
+    }
+
+    batch_keys.emplace_back(key);
+    accumulators.emplace_back(accumulator);
+
+    if (batch_keys.size() == kMeanBatchSize)
+    {
+      commitMeanBatch(mean_voxel, batch_keys, accumulators, means, local_coords, patterns);
+      updated_count += batch_keys.size();
+      batch_keys.clear();
+      accumulators.clear();
+    }
+  }
+
+  if (!batch_keys.empty())
+  {
+    commitMeanBatch(mean_voxel, batch_keys, accumulators, means, local_coords, patterns);
+    updated_count += batch_keys.size();
+  }
+
+  return updated_count;
+}
+}  // namespace ohm
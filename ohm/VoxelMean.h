@@ -162,6 +162,98 @@ inline void updatePosition(VoxelMean *mean_info, const glm::dvec3 &pos, const gl
   mean_info->count = std::min(mean_info->count, std::numeric_limits<unsigned>::max() - 1u) + 1;
 }
 
+/// @ingroup voxelmean
+/// Accumulates samples falling in a single voxel for a single, batched @c VoxelMean update. See
+/// @c updatePosition(VoxelMean *, const VoxelMeanAccumulator &, double) .
+///
+/// Samples are accumulated in full precision relative to the voxel centre, so the quantised @c VoxelMean::coord is
+/// only decoded and encoded once per voxel, rather than once per sample.
+struct VoxelMeanAccumulator
+{
+  /// Sum of the samples added, relative to the voxel centre.
+  glm::dvec3 local_sum{ 0 };
+  /// Number of samples added.
+  unsigned count = 0;
+
+  /// Add a sample.
+  /// @param pos The sample position.
+  /// @param voxel_centre Centre of the voxel containing @p pos .
+  inline void add(const glm::dvec3 &pos, const glm::dvec3 &voxel_centre)
+  {
+    local_sum += pos - voxel_centre;
+    ++count;
+  }
+
+  /// Clear the accumulated samples.
+  inline void reset()
+  {
+    local_sum = glm::dvec3(0);
+    count = 0;
+  }
+};
+
+/// @ingroup voxelmean
+/// Update the mean position for a voxel, incorporating all the samples in @p accumulator in one step.
+///
+/// This yields the same mean as calling @c updatePosition() for each sample, except that quantisation is applied once
+/// rather than once per sample. Does nothing when @p accumulator is empty.
+///
+/// @param mean_info Details of the voxel mean.
+/// @param accumulator The samples to incorporate into the mean.
+/// @param voxel_resolution Voxel resolution (size along each edge).
+inline void updatePosition(VoxelMean *mean_info, const VoxelMeanAccumulator &accumulator, double voxel_resolution)
+{
+  if (accumulator.count == 0)
+  {
+    return;
+  }
+
+  const glm::dvec3 mean = subVoxelToLocalCoord<glm::dvec3>(mean_info->coord, voxel_resolution);
+  const double existing_weight = double(mean_info->count);
+  const double total = existing_weight + double(accumulator.count);
+  mean_info->coord = subVoxelCoord((mean * existing_weight + accumulator.local_sum) / total, voxel_resolution);
+  // Saturate the count as the per sample update does.
+  mean_info->count = unsigned(std::min<uint64_t>(uint64_t(mean_info->count) + accumulator.count,
+                                                 std::numeric_limits<unsigned>::max()));
+}
+
+/// @ingroup voxelmean
+/// Encode an array of voxel local coordinates to voxel mean patterns. This is the array equivalent of
+/// @c subVoxelCoord() written as a flat, branch free loop so the compiler may vectorise it.
+/// @param voxel_local_coords The coordinates to encode, relative to their voxel centres.
+/// @param count Number of elements in @p voxel_local_coords and @p patterns .
+/// @param resolution The length of each voxel cube edge.
+/// @param[out] patterns The encoded patterns.
+void subVoxelCoordBatch(const glm::dvec3 *voxel_local_coords, size_t count, double resolution, unsigned *patterns);
+
+/// @ingroup voxelmean
+/// Decode an array of voxel mean patterns to voxel local coordinates. This is the array equivalent of
+/// @c subVoxelToLocalCoord() . See @c subVoxelCoordBatch() .
+/// @param patterns The patterns to decode.
+/// @param count Number of elements in @p patterns and @p voxel_local_coords .
+/// @param resolution The length of each voxel cube edge.
+/// @param[out] voxel_local_coords The decoded coordinates, relative to their voxel centres.
+void subVoxelToLocalCoordBatch(const unsigned *patterns, size_t count, double resolution,
+                               glm::dvec3 *voxel_local_coords);
+
+/// @ingroup voxelmean
+/// Update the @c VoxelMean layer of @p map for a set of samples sorted such that samples in the same voxel are
+/// contiguous, such as by @c Key or by region then @c Key .
+///
+/// Samples in each run of equal @c Key values are accumulated and the voxel is read and written once per run. The
+/// quantised mean patterns of all affected voxels are decoded and encoded in batches. Unsorted input is handled
+/// correctly, but each run is committed separately, so quantisation is applied once per run rather than once per
+/// voxel.
+///
+/// Does not update occupancy, only the mean layer. Does nothing if @p map has no mean layer.
+///
+/// @param map The map to update.
+/// @param keys The voxel key for each sample. Null keys are skipped.
+/// @param samples The sample positions.
+/// @param count Number of elements in @p keys and @p samples .
+/// @return The number of voxels updated.
+size_t updatePositionsSorted(OccupancyMap &map, const Key *keys, const glm::dvec3 *samples, size_t count);
+
 /// @ingroup voxelmean
 /// Update the mean position for a voxel, adjusting the mean with the new coordinate @p pos .
 ///
@@ -0,0 +1,125 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "VoxelMemoryPool.h"
+
+#include <iterator>
+
+namespace ohm
+{
+// Out of class definition for ODR use under C++14.
+constexpr size_t VoxelMemoryPool::kDefaultByteLimit;
+
+
+VoxelMemoryPool::VoxelMemoryPool(size_t byte_limit)
+  : byte_limit_(byte_limit)
+{}
+
+
+VoxelMemoryPool::~VoxelMemoryPool() = default;
+
+
+size_t VoxelMemoryPool::byteLimit() const
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  return byte_limit_;
+}
+
+
+void VoxelMemoryPool::setByteLimit(size_t byte_limit)
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  byte_limit_ = byte_limit;
+  trimUnguarded();
+}
+
+
+void VoxelMemoryPool::acquire(VoxelBytes &buffer, size_t byte_count)
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  ++stats_.acquire_count;
+  if (buffer.capacity() < byte_count)
+  {
+    auto size_class = size_classes_.find(byte_count);
+    if (size_class != size_classes_.end() && !size_class->second.empty())
+    {
+      // The previous buffer memory is freed with the pooled entry.
+      buffer.swap(size_class->second.back());
+      size_class->second.pop_back();
+      --stats_.pooled_buffers;
+      stats_.pooled_bytes -= byte_count;
+      ++stats_.recycle_count;
+    }
+  }
+  guard.unlock();
+
+  buffer.resize(byte_count);
+}
+
+
+void VoxelMemoryPool::release(VoxelBytes &buffer)
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  releaseUnguarded(buffer);
+}
+
+
+void VoxelMemoryPool::clear()
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  size_classes_.clear();
+  stats_.pooled_buffers = 0;
+  stats_.pooled_bytes = 0;
+}
+
+
+VoxelMemoryPoolStats VoxelMemoryPool::stats() const
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  return stats_;
+}
+
+
+void VoxelMemoryPool::releaseUnguarded(VoxelBytes &buffer)
+{
+  const size_t capacity = buffer.capacity();
+  if (capacity == 0)
+  {
+    return;
+  }
+
+  if (stats_.pooled_bytes + capacity <= byte_limit_)
+  {
+    buffer.clear();
+    size_classes_[capacity].emplace_back(std::move(buffer));
+    ++stats_.pooled_buffers;
+    stats_.pooled_bytes += capacity;
+    ++stats_.release_count;
+  }
+  else
+  {
+    ++stats_.discard_count;
+  }
+
+  // Free any remaining memory.
+  VoxelBytes().swap(buffer);
+}
+
+
+void VoxelMemoryPool::trimUnguarded()
+{
+  for (auto size_class = size_classes_.begin(); size_class != size_classes_.end() && stats_.pooled_bytes > byte_limit_;)
+  {
+    auto &buffers = size_class->second;
+    while (!buffers.empty() && stats_.pooled_bytes > byte_limit_)
+    {
+      stats_.pooled_bytes -= buffers.back().capacity();
+      --stats_.pooled_buffers;
+      buffers.pop_back();
+    }
+    size_class = (buffers.empty()) ? size_classes_.erase(size_class) : std::next(size_class);
+  }
+}
+}  // namespace ohm
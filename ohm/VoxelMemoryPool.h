@@ -0,0 +1,99 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELMEMORYPOOL_H
+#define OHM_VOXELMEMORYPOOL_H
+
+#include "OhmConfig.h"
+
+#include "HugePageAllocator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+/// Usage statistics for a @c VoxelMemoryPool .
+struct ohm_API VoxelMemoryPoolStats
+{
+  /// Number of @c VoxelMemoryPool::acquire() calls.
+  size_t acquire_count = 0;
+  /// Number of @c VoxelMemoryPool::acquire() calls satisfied by recycled memory.
+  size_t recycle_count = 0;
+  /// Number of buffers returned to the pool via @c VoxelMemoryPool::release() and retained.
+  size_t release_count = 0;
+  /// Number of buffers given to @c VoxelMemoryPool::release() which were freed because the pool was full.
+  size_t discard_count = 0;
+  /// Number of buffers currently held by the pool.
+  size_t pooled_buffers = 0;
+  /// Number of bytes currently held by the pool.
+  size_t pooled_bytes = 0;
+};
+
+/// A thread safe pool which recycles the voxel memory of @c VoxelBlock objects.
+///
+/// Voxel layer memory is allocated in a few fixed sizes - one per @c MapLayer - so freed buffers are retained in a
+/// size class matching their capacity and reused for the next allocation of that size. This avoids allocator churn
+/// and fragmentation when regions are continually created and removed, such as in a rolling window map using
+/// @c OccupancyMap::removeDistanceRegions() . The pool holds at most @c byteLimit() bytes; excess buffers are freed.
+///
+/// The buffers themselves may be backed by huge pages - see @c HugePageAllocator .
+///
+/// Each @c OccupancyMap owns a pool shared by its @c VoxelBlock objects. See @c OccupancyMap::voxelMemoryPool() .
+class ohm_API VoxelMemoryPool
+{
+public:
+  /// Default value for @c byteLimit() .
+  static constexpr size_t kDefaultByteLimit = size_t(64u) * 1024u * 1024u;
+
+  /// Constructor.
+  /// @param byte_limit The maximum number of bytes to retain. Zero disables pooling.
+  explicit VoxelMemoryPool(size_t byte_limit = kDefaultByteLimit);
+  /// Destructor.
+  ~VoxelMemoryPool();
+
+  /// Query the maximum number of bytes the pool retains.
+  /// @return The pool byte limit.
+  size_t byteLimit() const;
+  /// Set the maximum number of bytes the pool retains, freeing pooled buffers as required to meet the new limit.
+  /// @param byte_limit The new limit. Zero disables pooling.
+  void setByteLimit(size_t byte_limit);
+
+  /// Acquire memory for @p buffer , resizing it to @p byte_count . When @p buffer lacks the capacity, a pooled buffer
+  /// of @p byte_count capacity replaces the @p buffer memory if available. The content of @p buffer is undefined on
+  /// return.
+  /// @param buffer The buffer to allocate memory for. Existing memory is freed when replaced.
+  /// @param byte_count The required buffer size.
+  void acquire(VoxelBytes &buffer, size_t byte_count);
+
+  /// Return the memory of @p buffer to the pool, or free it if the pool is full. The @p buffer is empty on return.
+  /// @param buffer The buffer to release.
+  void release(VoxelBytes &buffer);
+
+  /// Free all pooled memory. Statistics are retained.
+  void clear();
+
+  /// Query the current pool statistics.
+  /// @return The pool statistics.
+  VoxelMemoryPoolStats stats() const;
+
+private:
+  /// Release or discard @p buffer . Requires @c mutex_ be locked.
+  void releaseUnguarded(VoxelBytes &buffer);
+  /// Discard pooled buffers until within the byte limit. Requires @c mutex_ be locked.
+  void trimUnguarded();
+
+  mutable std::mutex mutex_;
+  /// Pooled buffers keyed by capacity.
+  std::unordered_map<size_t, std::vector<VoxelBytes>> size_classes_;
+  VoxelMemoryPoolStats stats_;
+  size_t byte_limit_ = kDefaultByteLimit;
+};
+}  // namespace ohm
+
+#endif  // OHM_VOXELMEMORYPOOL_H
@@ -0,0 +1,145 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELORDER_H
+#define OHM_VOXELORDER_H
+
+#include "OhmConfig.h"
+
+#include "MapFlag.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+
+namespace ohm
+{
+#include "VoxelOrderCompute.h"
+
+/// Identifies the order in which voxels are stored in the memory of each @c MapChunk layer.
+///
+/// The order only affects the voxel memory layout: the mapping between a voxel's local @c Key and its index in the
+/// layer memory. Voxel iteration, @c Key semantics and @c MapChunk::first_valid_index are unaffected and remain in
+/// row major order.
+///
+/// Row major order is the default and is always supported. The other orders keep spatially close voxels closer in
+/// memory, improving cache locality when tracing rays which are not aligned with the x axis. These orders impose
+/// constraints on the layer dimensions and a layer falls back to row major order when the constraints are not met -
+/// see @c resolveVoxelOrder() .
+///
+/// The voxel order is selected on map creation using @c MapFlag::kVoxelOrderMorton or @c MapFlag::kVoxelOrderBrick4 .
+enum class VoxelOrder : uint8_t
+{
+  /// Row major order: x, then y, then z.
+  kRowMajor = OHM_VOXEL_ORDER_ROW_MAJOR,
+  /// Morton (Z-curve) order, interleaving the bits of the local coordinates. Requires cubic, power of two dimensions.
+  kMorton = OHM_VOXEL_ORDER_MORTON,
+  /// Row major ordered 4x4x4 voxel bricks with row major order within each brick. Requires each dimension to be a
+  /// multiple of four.
+  kBrick4 = OHM_VOXEL_ORDER_BRICK4
+};
+
+/// @c MapFlag bits which select the @c VoxelOrder .
+constexpr MapFlag kVoxelOrderFlags =
+  MapFlag(unsigned(MapFlag::kVoxelOrderMorton) | unsigned(MapFlag::kVoxelOrderBrick4));
+
+/// Resolve the @c VoxelOrder requested by the given map @p flags . @c MapFlag::kVoxelOrderMorton takes precedence
+/// should both order flags be set.
+/// @param flags The map flags.
+/// @return The requested voxel order.
+inline VoxelOrder voxelOrderFromFlags(MapFlag flags)
+{
+  if ((flags & MapFlag::kVoxelOrderMorton) != MapFlag::kNone)
+  {
+    return VoxelOrder::kMorton;
+  }
+  if ((flags & MapFlag::kVoxelOrderBrick4) != MapFlag::kNone)
+  {
+    return VoxelOrder::kBrick4;
+  }
+  return VoxelOrder::kRowMajor;
+}
+
+/// Convert a @c VoxelOrder into the @c MapFlag which selects it.
+/// @param order The voxel order.
+/// @return The corresponding flag, or @c MapFlag::kNone for @c VoxelOrder::kRowMajor .
+inline MapFlag voxelOrderFlag(VoxelOrder order)
+{
+  switch (order)
+  {
+  case VoxelOrder::kMorton:
+    return MapFlag::kVoxelOrderMorton;
+  case VoxelOrder::kBrick4:
+    return MapFlag::kVoxelOrderBrick4;
+  default:
+    break;
+  }
+  return MapFlag::kNone;
+}
+
+/// Check if @p order can be used for a layer with the given voxel dimensions.
+/// @param order The voxel order of interest.
+/// @param dim The layer voxel dimensions.
+/// @return True if @p order is supported.
+inline bool voxelOrderSupported(VoxelOrder order, const glm::ivec3 &dim)
+{
+  switch (order)
+  {
+  case VoxelOrder::kMorton:
+    // Cubic and a power of two.
+    return dim.x > 0 && dim.x == dim.y && dim.x == dim.z && (dim.x & (dim.x - 1)) == 0;
+  case VoxelOrder::kBrick4:
+    return dim.x > 0 && dim.y > 0 && dim.z > 0 && dim.x % OHM_VOXEL_BRICK_DIM == 0 &&
+           dim.y % OHM_VOXEL_BRICK_DIM == 0 && dim.z % OHM_VOXEL_BRICK_DIM == 0;
+  default:
+    break;
+  }
+  return true;
+}
+
+/// Resolve the voxel order to use for a layer with the given voxel dimensions. This is @p order when supported,
+/// falling back to @c VoxelOrder::kRowMajor otherwise.
+/// @param order The requested voxel order, generally the @c OccupancyMap::voxelOrder() .
+/// @param dim The layer voxel dimensions.
+/// @return The voxel order to use for the layer.
+inline VoxelOrder resolveVoxelOrder(VoxelOrder order, const glm::ivec3 &dim)
+{
+  return (voxelOrderSupported(order, dim)) ? order : VoxelOrder::kRowMajor;
+}
+
+/// Convert a voxel memory index into a local voxel key for the given voxel @p order . This is the inverse of
+/// @c orderedVoxelIndex() .
+/// @param index The voxel memory index.
+/// @param dim The layer voxel dimensions.
+/// @param order The voxel order. Must be supported by @p dim - see @c resolveVoxelOrder() .
+/// @return The local voxel key.
+inline glm::u8vec3 orderedVoxelLocalKey(unsigned index, const glm::ivec3 &dim, VoxelOrder order)
+{
+  switch (order)
+  {
+  case VoxelOrder::kMorton:
+    return glm::u8vec3(mortonCompactBits3(index), mortonCompactBits3(index >> 1u), mortonCompactBits3(index >> 2u));
+  case VoxelOrder::kBrick4:
+  {
+    const unsigned brick_volume = OHM_VOXEL_BRICK_DIM * OHM_VOXEL_BRICK_DIM * OHM_VOXEL_BRICK_DIM;
+    const unsigned bricks_x = unsigned(dim.x) / OHM_VOXEL_BRICK_DIM;
+    const unsigned bricks_y = unsigned(dim.y) / OHM_VOXEL_BRICK_DIM;
+    const unsigned brick_index = index / brick_volume;
+    const unsigned in_brick_index = index % brick_volume;
+    const glm::uvec3 brick(brick_index % bricks_x, (brick_index / bricks_x) % bricks_y,
+                           brick_index / (bricks_x * bricks_y));
+    const glm::uvec3 in_brick(in_brick_index % OHM_VOXEL_BRICK_DIM,
+                              (in_brick_index / OHM_VOXEL_BRICK_DIM) % OHM_VOXEL_BRICK_DIM,
+                              in_brick_index / (OHM_VOXEL_BRICK_DIM * OHM_VOXEL_BRICK_DIM));
+    return glm::u8vec3(brick * unsigned(OHM_VOXEL_BRICK_DIM) + in_brick);
+  }
+  default:
+    break;
+  }
+  return glm::u8vec3(index % dim.x, (index % (dim.x * dim.y)) / dim.x, index / (dim.x * dim.y));
+}
+}  // namespace ohm
+
+#endif  // OHM_VOXELORDER_H
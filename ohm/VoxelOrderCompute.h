@@ -0,0 +1,92 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXEL_ORDER_COMPUTE_H
+#define OHM_VOXEL_ORDER_COMPUTE_H
+
+// Do not include config header. This can be used from GPU code.
+
+#if !GPUTIL_DEVICE
+#define OHM_DEVICE_HOST
+#else  // GPUTIL_DEVICE
+#define OHM_DEVICE_HOST __device__ __host__
+#endif  // GPUTIL_DEVICE
+
+/// Voxels are stored in row major order: x, then y, then z. See @c ohm::VoxelOrder::kRowMajor .
+#define OHM_VOXEL_ORDER_ROW_MAJOR 0
+/// Voxels are stored in Morton (Z-curve) order. See @c ohm::VoxelOrder::kMorton .
+#define OHM_VOXEL_ORDER_MORTON 1
+/// Voxels are stored in row major 4x4x4 bricks. See @c ohm::VoxelOrder::kBrick4 .
+#define OHM_VOXEL_ORDER_BRICK4 2
+
+/// Brick edge length for @c OHM_VOXEL_ORDER_BRICK4 .
+#define OHM_VOXEL_BRICK_DIM 4
+
+/// Spread the lower 10 bits of @p value so there are two zero bits between each bit.
+/// @param value The value to spread.
+/// @return The spread bits of @p value .
+inline unsigned OHM_DEVICE_HOST mortonSpreadBits3(unsigned value)
+{
+  value &= 0x3ffu;  // NOLINT(readability-magic-numbers)
+  value = (value | (value << 16u)) & 0x030000ffu;  // NOLINT(readability-magic-numbers)
+  value = (value | (value << 8u)) & 0x0300f00fu;  // NOLINT(readability-magic-numbers)
+  value = (value | (value << 4u)) & 0x030c30c3u;  // NOLINT(readability-magic-numbers)
+  value = (value | (value << 2u)) & 0x09249249u;  // NOLINT(readability-magic-numbers)
+  return value;
+}
+
+/// Inverse of @c mortonSpreadBits3() , compacting every third bit of @p value .
+/// @param value The spread value.
+/// @return The compacted bits of @p value .
+inline unsigned OHM_DEVICE_HOST mortonCompactBits3(unsigned value)
+{
+  value &= 0x09249249u;  // NOLINT(readability-magic-numbers)
+  value = (value | (value >> 2u)) & 0x030c30c3u;  // NOLINT(readability-magic-numbers)
+  value = (value | (value >> 4u)) & 0x0300f00fu;  // NOLINT(readability-magic-numbers)
+  value = (value | (value >> 8u)) & 0x030000ffu;  // NOLINT(readability-magic-numbers)
+  value = (value | (value >> 16u)) & 0x3ffu;  // NOLINT(readability-magic-numbers)
+  return value;
+}
+
+/// Calculate the index of a voxel in a region's voxel memory for the given voxel @p order .
+///
+/// The @p order must be supported by the region dimensions. @c OHM_VOXEL_ORDER_MORTON requires cubic regions with a
+/// power of two edge length, while @c OHM_VOXEL_ORDER_BRICK4 requires each dimension to be a multiple of
+/// @c OHM_VOXEL_BRICK_DIM . Any other @p order value is treated as @c OHM_VOXEL_ORDER_ROW_MAJOR .
+///
+/// @param x The local voxel x coordinate within the region.
+/// @param y The local voxel y coordinate within the region.
+/// @param z The local voxel z coordinate within the region.
+/// @param dim_x The region voxel dimension along x.
+/// @param dim_y The region voxel dimension along y.
+/// @param dim_z The region voxel dimension along z.
+/// @param order The voxel order: one of the @c OHM_VOXEL_ORDER_ values.
+/// @return The voxel memory index.
+inline unsigned OHM_DEVICE_HOST orderedVoxelIndex(unsigned x, unsigned y, unsigned z, unsigned dim_x, unsigned dim_y,
+                                                  unsigned dim_z, unsigned order)
+{
+  (void)dim_z;
+  if (order == OHM_VOXEL_ORDER_MORTON)
+  {
+    return mortonSpreadBits3(x) | (mortonSpreadBits3(y) << 1u) | (mortonSpreadBits3(z) << 2u);
+  }
+
+  if (order == OHM_VOXEL_ORDER_BRICK4)
+  {
+    const unsigned bricks_x = dim_x / OHM_VOXEL_BRICK_DIM;
+    const unsigned bricks_y = dim_y / OHM_VOXEL_BRICK_DIM;
+    const unsigned brick_index = (x / OHM_VOXEL_BRICK_DIM) + (y / OHM_VOXEL_BRICK_DIM) * bricks_x +
+                                 (z / OHM_VOXEL_BRICK_DIM) * bricks_x * bricks_y;
+    const unsigned in_brick_index = (x % OHM_VOXEL_BRICK_DIM) + (y % OHM_VOXEL_BRICK_DIM) * OHM_VOXEL_BRICK_DIM +
+                                    (z % OHM_VOXEL_BRICK_DIM) * OHM_VOXEL_BRICK_DIM * OHM_VOXEL_BRICK_DIM;
+    return brick_index * OHM_VOXEL_BRICK_DIM * OHM_VOXEL_BRICK_DIM * OHM_VOXEL_BRICK_DIM + in_brick_index;
+  }
+
+  return x + y * dim_x + z * dim_x * dim_y;
+}
+
+#undef OHM_DEVICE_HOST
+
+#endif  // OHM_VOXEL_ORDER_COMPUTE_H
@@ -0,0 +1,174 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "VoxelRangeCache.h"
+
+#include "private/VoxelAlgorithms.h"
+#include "private/VoxelRangeCacheDetail.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "OccupancyMap.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ohm
+{
+namespace
+{
+/// Check whether any region within the search extents of @p region_key has changed since @p stamp .
+bool regionNeighbourhoodChanged(const OccupancyMap &map, const glm::i16vec3 &region_key,
+                                const glm::ivec3 &voxel_search_half_extents, uint64_t stamp)
+{
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  // Number of regions spanned by the search extents, rounding up.
+  const glm::ivec3 span = (voxel_search_half_extents + region_dim - glm::ivec3(1)) / region_dim;
+  glm::ivec3 offset;
+  for (offset.z = -span.z; offset.z <= span.z; ++offset.z)
+  {
+    for (offset.y = -span.y; offset.y <= span.y; ++offset.y)
+    {
+      for (offset.x = -span.x; offset.x <= span.x; ++offset.x)
+      {
+        const glm::ivec3 neighbour = glm::ivec3(region_key) + offset;
+        if (glm::any(glm::lessThan(neighbour, glm::ivec3(std::numeric_limits<int16_t>::min()))) ||
+            glm::any(glm::greaterThan(neighbour, glm::ivec3(std::numeric_limits<int16_t>::max()))))
+        {
+          continue;
+        }
+        const MapChunk *chunk = map.region(glm::i16vec3(neighbour));
+        if (chunk && chunk->dirty_stamp.load(std::memory_order_relaxed) > stamp)
+        {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+}  // namespace
+
+
+VoxelRangeCache::VoxelRangeCache()
+  : imp_(std::make_unique<VoxelRangeCacheDetail>())
+{}
+
+
+VoxelRangeCache::~VoxelRangeCache() = default;
+
+
+float VoxelRangeCache::range(const Key &voxel_key, const OccupancyMap &map,
+                             const glm::ivec3 &voxel_search_half_extents, bool unobserved_as_occupied, bool ignore_self,
+                             float search_range, const glm::vec3 &axis_scaling, bool report_unscaled_distance)
+{
+  VoxelRangeRegionKey cache_key;
+  cache_key.region_key = voxel_key.regionKey();
+  cache_key.params.map = &map;
+  cache_key.params.voxel_search_half_extents = voxel_search_half_extents;
+  cache_key.params.axis_scaling = axis_scaling;
+  cache_key.params.search_range = search_range;
+  cache_key.params.unobserved_as_occupied = unobserved_as_occupied;
+  cache_key.params.ignore_self = ignore_self;
+  cache_key.params.report_unscaled_distance = report_unscaled_distance;
+
+  const unsigned voxel_index = voxelIndex(voxel_key, glm::ivec3(map.regionVoxelDimensions()));
+  VoxelRangeCacheDetail::Stripe &stripe =
+    imp_->stripes[VoxelRangeRegionKey::Hash()(cache_key) % VoxelRangeCacheDetail::kStripeCount];
+
+  uint64_t cache_stamp = 0;
+  VoxelRangeRegion *region = nullptr;
+  {
+    std::unique_lock<Mutex> guard(stripe.mutex);
+    const uint64_t map_stamp = map.stamp();
+    auto iter = stripe.regions.find(cache_key);
+    if (iter == stripe.regions.end())
+    {
+      iter = stripe.regions.emplace(cache_key, VoxelRangeRegion()).first;
+      iter->second.ranges.resize(map.regionVoxelVolume(), std::numeric_limits<float>::quiet_NaN());
+      iter->second.cache_stamp = iter->second.validated_stamp = map_stamp;
+    }
+    region = &iter->second;
+
+    if (region->validated_stamp != map_stamp)
+    {
+      if (regionNeighbourhoodChanged(map, cache_key.region_key, voxel_search_half_extents, region->cache_stamp))
+      {
+        std::fill(region->ranges.begin(), region->ranges.end(), std::numeric_limits<float>::quiet_NaN());
+        region->cache_stamp = map_stamp;
+        ++imp_->invalidations;
+      }
+      region->validated_stamp = map_stamp;
+    }
+
+    const float cached = region->ranges[voxel_index];
+    if (!std::isnan(cached))
+    {
+      ++imp_->hits;
+      return cached;
+    }
+    cache_stamp = region->cache_stamp;
+  }
+
+  ++imp_->misses;
+  // Calculate without holding the lock.
+  const float range = calculateNearestNeighbour(voxel_key, map, voxel_search_half_extents, unobserved_as_occupied,
+                                                ignore_self, search_range, axis_scaling, report_unscaled_distance);
+
+  std::unique_lock<Mutex> guard(stripe.mutex);
+  // Only store the result if the region has not since been invalidated. Map changes since cache_stamp will
+  // invalidate the result on the next validation.
+  if (region->cache_stamp == cache_stamp)
+  {
+    region->ranges[voxel_index] = range;
+  }
+
+  return range;
+}
+
+
+void VoxelRangeCache::clear()
+{
+  for (auto &stripe : imp_->stripes)
+  {
+    std::unique_lock<Mutex> guard(stripe.mutex);
+    stripe.regions.clear();
+  }
+  imp_->hits = imp_->misses = imp_->invalidations = 0;
+}
+
+
+size_t VoxelRangeCache::regionCount() const
+{
+  size_t count = 0;
+  for (auto &stripe : imp_->stripes)
+  {
+    std::unique_lock<Mutex> guard(stripe.mutex);
+    count += stripe.regions.size();
+  }
+  return count;
+}
+
+
+uint64_t VoxelRangeCache::hitCount() const
+{
+  return imp_->hits;
+}
+
+
+uint64_t VoxelRangeCache::missCount() const
+{
+  return imp_->misses;
+}
+
+
+uint64_t VoxelRangeCache::invalidationCount() const
+{
+  return imp_->invalidations;
+}
+}  // namespace ohm
@@ -0,0 +1,89 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELRANGECACHE_H
+#define OHM_VOXELRANGECACHE_H
+
+#include "OhmConfig.h"
+
+#include <glm/fwd.hpp>
+
+#include <cstdint>
+#include <memory>
+
+namespace ohm
+{
+class Key;
+class OccupancyMap;
+struct VoxelRangeCacheDetail;
+
+/// A thread safe cache of voxel obstacle ranges, as calculated by @c calculateNearestNeighbour() , which persists
+/// across queries.
+///
+/// The cache is intended for issuing many overlapping queries over a largely static map, such as the line queries of
+/// a trajectory optimiser. It may be shared by any number of queries - see @c LineQuery::setRangeCache() - including
+/// queries executing concurrently. Ranges are cached per map region and per set of range parameters, so queries with
+/// different search radii or axis scaling may share a cache without interfering.
+///
+/// Cached ranges are invalidated by region. A voxel range depends on all voxels within the search extents, so a
+/// region's ranges are discarded when the @c MapChunk::dirty_stamp of any region within the search extents of that
+/// region advances beyond the @c OccupancyMap::stamp() at which the ranges were cached. This check is made at most
+/// once per region for each map stamp, so there is no validation overhead while the map is unchanged.
+///
+/// Removing regions from the map does not advance any stamp, so @c clear() must be called after removing regions,
+/// clearing the map or replacing the map at the same address.
+class ohm_API VoxelRangeCache
+{
+public:
+  /// Create an empty cache.
+  VoxelRangeCache();
+  /// Destructor.
+  ~VoxelRangeCache();
+
+  VoxelRangeCache(const VoxelRangeCache &) = delete;
+  VoxelRangeCache &operator=(const VoxelRangeCache &) = delete;
+
+  /// Query the obstacle range for a voxel, calculating and caching the range if there is no valid cached value.
+  ///
+  /// The arguments match @c calculateNearestNeighbour() and the results are identical. Safe to call concurrently.
+  ///
+  /// @param voxel_key The key of the voxel of interest.
+  /// @param map The map to search.
+  /// @param voxel_search_half_extents The search extents in voxels. See @c calculateVoxelSearchHalfExtents() .
+  /// @param unobserved_as_occupied Treat unobserved voxels as occupied?
+  /// @param ignore_self Ignore the voxel at @p voxel_key ?
+  /// @param search_range The search range limit.
+  /// @param axis_scaling Per axis distance scaling.
+  /// @param report_unscaled_distance Report the distance without @p axis_scaling ?
+  /// @return The obstacle range for @p voxel_key as given by @c calculateNearestNeighbour() .
+  float range(const Key &voxel_key, const OccupancyMap &map, const glm::ivec3 &voxel_search_half_extents,
+              bool unobserved_as_occupied, bool ignore_self, float search_range, const glm::vec3 &axis_scaling,
+              bool report_unscaled_distance = false);
+
+  /// Discard all cached ranges and reset the statistics. Must not be called concurrently with @c range() .
+  void clear();
+
+  /// Query the number of cached regions, summed across all range parameter sets.
+  /// @return The number of cached regions.
+  size_t regionCount() const;
+
+  /// Query the number of @c range() calls which used a cached value.
+  /// @return The cache hit count.
+  uint64_t hitCount() const;
+
+  /// Query the number of @c range() calls which calculated the range.
+  /// @return The cache miss count.
+  uint64_t missCount() const;
+
+  /// Query the number of times cached region ranges have been invalidated by map changes.
+  /// @return The invalidation count.
+  uint64_t invalidationCount() const;
+
+private:
+  std::unique_ptr<VoxelRangeCacheDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_VOXELRANGECACHE_H
@@ -8,35 +8,13 @@
 
 #include "OhmConfig.h"
 
+#include "VoxelSecondarySampleCompute.h"
+
 #include <cinttypes>
 #include <limits>
 
 namespace ohm
 {
-/// Stores information about secondary samples (dual returns) collected in a voxel.
-///
-/// Lidar dual returns may be considered as secondary samples in OHM provdied the secondary sample layer is used.
-/// Each voxel stores the information provided in this structure. This stores the number of secondary samples recorded
-/// by a voxel and additional values to provide the mean distance between primary and secondary samples for this voxel
-/// and the standard deviation thereof.
-///
-/// @note The @c range_mean is stored as a @c uint16_t value in order to keep the voxel size at 8 bytes. The range is
-/// quantised to 1000th of the input value. OHM generally expects metres, so the range is generally in millimetres.
-/// The quantisation factor is exposed via @c secondarySampleQuantisationFactor() .
-///
-/// Use @c secondarySampleRangeMean() and @c secondarySampleRangeStdDev() in order to extract the range mean and
-/// standard deviation values.
-struct VoxelSecondarySample
-{
-  /// Used to calculate the standard deviation, @c m2 aggregates the squared distance from the mean.
-  float m2;
-  /// Standard mean distance between the primary sample and the secondary sample for secondary samples falling in this
-  /// voxel.
-  uint16_t range_mean;
-  /// The number of secondary samples which have been collected in this voxel.
-  uint16_t count;
-};
-
 /// Quantisation factor used for @c VoxelSecondarySample::range_mean . This relates the normal occupancy map units to
 /// the quantised value using:
 ///
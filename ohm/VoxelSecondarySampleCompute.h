@@ -0,0 +1,89 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXEL_SECONDARY_SAMPLE_COMPUTE_H
+#define OHM_VOXEL_SECONDARY_SAMPLE_COMPUTE_H
+
+// Do not include config header. This can be used from GPU code.
+
+/// Quantisation factor for @c VoxelSecondarySample::range_mean - see @c secondarySampleQuantisationFactor() .
+#define OHM_SECONDARY_SAMPLE_QUANTISATION 1000.0f
+/// Maximum range which can be stored in @c VoxelSecondarySample::range_mean - see @c secondarySampleMaxRange() .
+#define OHM_SECONDARY_SAMPLE_MAX_RANGE ((65535.0f - 1.0f) / OHM_SECONDARY_SAMPLE_QUANTISATION)
+
+#if !GPUTIL_DEVICE
+#include <cinttypes>
+
+#define OHM_DEVICE_HOST
+
+namespace ohm
+{
+/// Stores information about secondary samples (dual returns) collected in a voxel.
+///
+/// Lidar dual returns may be considered as secondary samples in OHM provdied the secondary sample layer is used.
+/// Each voxel stores the information provided in this structure. This stores the number of secondary samples recorded
+/// by a voxel and additional values to provide the mean distance between primary and secondary samples for this voxel
+/// and the standard deviation thereof.
+///
+/// @note The @c range_mean is stored as a @c uint16_t value in order to keep the voxel size at 8 bytes. The range is
+/// quantised to 1000th of the input value. OHM generally expects metres, so the range is generally in millimetres.
+/// The quantisation factor is exposed via @c secondarySampleQuantisationFactor() .
+///
+/// Use @c secondarySampleRangeMean() and @c secondarySampleRangeStdDev() in order to extract the range mean and
+/// standard deviation values.
+struct VoxelSecondarySample
+{
+  /// Used to calculate the standard deviation, @c m2 aggregates the squared distance from the mean.
+  float m2;
+  /// Standard mean distance between the primary sample and the secondary sample for secondary samples falling in this
+  /// voxel.
+  uint16_t range_mean;
+  /// The number of secondary samples which have been collected in this voxel.
+  uint16_t count;
+};
+}  // namespace ohm
+
+#else  // !GPUTIL_DEVICE
+
+#define OHM_DEVICE_HOST __device__ __host__
+
+/// GPU equivalent of @c ohm::VoxelSecondarySample . The layout must match.
+typedef struct VoxelSecondarySample_t
+{
+  float m2;
+  ushort range_mean;
+  ushort count;
+} VoxelSecondarySample;
+
+#endif  // !GPUTIL_DEVICE
+
+#if !GPUTIL_DEVICE
+namespace ohm
+{
+#endif  // !GPUTIL_DEVICE
+/// Single precision update of @p voxel for an additional secondary sample. This matches @c addSecondarySample() ,
+/// which is the double precision, CPU version, and is used by the GPU update.
+///
+/// @param voxel The voxel to update in which the secondary sample lies.
+/// @param range The distance between the primary and secondary samples. Must be positive.
+inline OHM_DEVICE_HOST void addSecondarySampleF(VoxelSecondarySample *voxel, float range)
+{
+  // Using Wellford's algorithm.
+  range = (range < OHM_SECONDARY_SAMPLE_MAX_RANGE) ? range : OHM_SECONDARY_SAMPLE_MAX_RANGE;
+  float range_mean = (float)voxel->range_mean / OHM_SECONDARY_SAMPLE_QUANTISATION;
+  ++voxel->count;
+  const float delta = range - range_mean;
+  range_mean += delta / (float)voxel->count;
+  voxel->range_mean = (unsigned short)(range_mean * OHM_SECONDARY_SAMPLE_QUANTISATION);
+  const float delta2 = range - range_mean;
+  voxel->m2 += delta * delta2;
+}
+#if !GPUTIL_DEVICE
+}  // namespace ohm
+#endif  // !GPUTIL_DEVICE
+
+#undef OHM_DEVICE_HOST
+
+#endif  // OHM_VOXEL_SECONDARY_SAMPLE_COMPUTE_H
@@ -0,0 +1,477 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMVOXELSET_H
+#define OHMVOXELSET_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "VoxelBlock.h"
+
+#include <array>
+#include <cinttypes>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+namespace ohm
+{
+namespace detail
+{
+/// Helper to determine if all the @c VoxelSet layer types are @c const .
+template <typename... T>
+struct VoxelSetAllConst;
+
+/// @overload
+template <>
+struct VoxelSetAllConst<> : std::true_type
+{
+};
+
+/// @overload
+template <typename T, typename... Rest>
+struct VoxelSetAllConst<T, Rest...>
+  : std::integral_constant<bool, std::is_const<T>::value && VoxelSetAllConst<Rest...>::value>
+{
+};
+
+/// Internal helper to manage mutable @c VoxelSet chunk access and book keeping.
+template <bool ReadOnly>
+struct VoxelSetAccess
+{
+  /// Resolve a mutable chunk for @p key from @p map , creating the chunk if required.
+  /// @param map The map of interest.
+  /// @param key The key to resolve the chunk for.
+  /// @return The chunk for @p key .
+  static MapChunk *chunk(OccupancyMap *map, const Key &key) { return map->region(key.regionKey(), true); }
+
+  /// Update the first valid index for @p chunk using @p voxel_index .
+  /// @param chunk The map chunk being touched: must be valid.
+  /// @param voxel_index The linear index of the modified voxel.
+  static void touch(MapChunk *chunk, unsigned voxel_index) { chunk->updateFirstValid(voxel_index); }
+
+  /// Mark @p chunk as having been updated in each of the @p touched_layers using a single @c OccupancyMap::touch() .
+  /// @param map The map of interest.
+  /// @param chunk The map chunk being touched: must be valid.
+  /// @param layer_indices The map layer indices for the @c VoxelSet .
+  /// @param touched_layers Bit set of the @p layer_indices entries to touch.
+  template <size_t N>
+  static void touch(OccupancyMap *map, MapChunk *chunk, const std::array<int, N> &layer_indices,
+                    unsigned touched_layers)
+  {
+    const uint64_t stamp = map->touch();
+    chunk->markDirty(stamp);
+    for (size_t i = 0; i < N; ++i)
+    {
+      if (touched_layers & (1u << i))
+      {
+        chunk->touched_stamps[layer_indices[i]].store(stamp, std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+/// Internal helper to manage const @c VoxelSet chunk access. Supports fetching existing chunks, but no modification.
+template <>
+struct VoxelSetAccess<true>
+{
+  /// Query the @c MapChunk pointer for @p key.
+  /// @param map The Occupancy map of interest
+  /// @param key The key to get a chunk for.
+  /// @return The @c MapChunk for key, or null if the chunk does not exist.
+  static const MapChunk *chunk(const OccupancyMap *map, const Key &key) { return map->region(key.regionKey()); }
+
+  /// Noop.
+  /// @param chunk Ignored.
+  /// @param voxel_index Ignored.
+  static void touch(const MapChunk *chunk, unsigned voxel_index)
+  {
+    (void)chunk;
+    (void)voxel_index;
+  }
+
+  /// Noop.
+  /// @param map Ignored.
+  /// @param chunk Ignored.
+  /// @param layer_indices Ignored.
+  /// @param touched_layers Ignored.
+  template <size_t N>
+  static void touch(const OccupancyMap *map, const MapChunk *chunk, const std::array<int, N> &layer_indices,
+                    unsigned touched_layers)
+  {
+    (void)map;
+    (void)chunk;
+    (void)layer_indices;
+    (void)touched_layers;
+  }
+};
+}  // namespace detail
+
+/// A multi-layer voxel accessor binding several @c MapLayer data types together for a single @c Key .
+///
+/// A @c VoxelSet fills the same role as a set of @c Voxel objects updated using @c setVoxelKey() , but resolves the
+/// @c MapChunk once per key change and binds all the layer voxel memory pointers together. The layer data types are
+/// fixed at compile time by the template arguments and are accessed by their index in the argument list. Layers are
+/// validated on construction by comparing the @c MapLayer::voxelByteSize() against the size of each type.
+///
+/// Book keeping is batched across the layers. Changing chunk, @c commit() or destruction makes a single
+/// @c OccupancyMap::touch() call, sharing the stamp across the @c MapChunk::dirty_stamp and the
+/// @c MapChunk::touched_stamps of each modified layer. @c MapChunk::first_valid_index is updated once for each
+/// modified voxel.
+///
+/// The set is read only when all the layer types are @c const . A read only set uses a const @c OccupancyMap and never
+/// creates a @c MapChunk . Otherwise, setting the key creates the chunk as required and only the non-const layer types
+/// may be written.
+///
+/// @code
+/// void addSample(ohm::OccupancyMap &map, const ohm::Key &key, float value, const ohm::VoxelMean &mean)
+/// {
+///   ohm::VoxelSet<float, ohm::VoxelMean> voxels(
+///     &map, { map.layout().occupancyLayer(), map.layout().meanLayer() });
+///   voxels.setKey(key);
+///   voxels.write<0>(value);
+///   voxels.write<1>(mean);
+/// }
+/// @endcode
+template <typename... T>
+class VoxelSet
+{
+public:
+  /// The number of layers in the set.
+  static constexpr size_t kLayerCount = sizeof...(T);
+  /// True if all layer types are const.
+  static constexpr bool kReadOnly = detail::VoxelSetAllConst<T...>::value;
+
+  static_assert(kLayerCount > 0, "VoxelSet requires at least one layer");
+  static_assert(kLayerCount <= 32, "VoxelSet supports at most 32 layers");
+
+  /// The template type at index @c I . May be const.
+  template <size_t I>
+  using LayerType = typename std::tuple_element<I, std::tuple<T...>>::type;
+  /// Non-const data type for the layer at index @c I .
+  template <size_t I>
+  using DataType = typename std::remove_const<LayerType<I>>::type;
+  /// Const or non-const @c OccupancyMap iterator based on @c kReadOnly .
+  using MapIteratorType =
+    typename std::conditional<kReadOnly, OccupancyMap::const_iterator, OccupancyMap::iterator>::type;
+  /// Const or non-const @c OccupancyMap pointer based on @c kReadOnly .
+  using MapTypePtr = typename std::conditional<kReadOnly, const OccupancyMap *, OccupancyMap *>::type;
+  /// Const or non-const @c MapChunk pointer based on @c kReadOnly .
+  using MapChunkPtr = typename std::conditional<kReadOnly, const MapChunk *, MapChunk *>::type;
+  /// Voxel data pointer - @c const if @c kReadOnly .
+  using VoxelDataPtr = typename std::conditional<kReadOnly, const uint8_t *, uint8_t *>::type;
+
+  /// Error flag values indicating why initialisation may have failed.
+  enum class Error : uint16_t
+  {
+    kNone = 0,                        ///< No error
+    kNullMap = (1u << 0u),            ///< @c OccupancyMap is null
+    kInvalidLayerIndex = (1u << 1u),  ///< One of the given layer indices is invalid.
+    kVoxelSizeMismatch = (1u << 2u)   ///< A @c MapLayer voxel size does not match the size of its type.
+  };
+
+  /// Empty constructor generating an invalid set with no map.
+  VoxelSet() = default;
+  /// Create a @c VoxelSet for @p map binding the @p layer_indices to the template types in order. The map and layers
+  /// are validated (see @c Error flags) and @c isLayerValid() will be true on success. The key is not set so
+  /// @c isValid() remains false.
+  /// @param map The map to access and mutate for a mutable set.
+  /// @param layer_indices The @c MapLayer indices for each template type.
+  VoxelSet(MapTypePtr map, const std::array<int, kLayerCount> &layer_indices);
+  /// Create a @c VoxelSet for @p map and reference the voxel at @p key . See
+  /// @c VoxelSet(MapTypePtr,const std::array<int,kLayerCount>&) .
+  /// @param map The map to access and mutate for a mutable set.
+  /// @param layer_indices The @c MapLayer indices for each template type.
+  /// @param key The key for the voxel to initially reference.
+  VoxelSet(MapTypePtr map, const std::array<int, kLayerCount> &layer_indices, const Key &key);
+
+  VoxelSet(const VoxelSet &) = delete;
+  VoxelSet &operator=(const VoxelSet &) = delete;
+
+  /// Destructor, ensures book keeping operations are completed on the @c MapChunk .
+  inline ~VoxelSet() { updateTouch(false); }
+
+  /// Check if the map and layer references are valid and error flags are clear.
+  /// @return True if the @c map() is not null, all layers are valid and @c errorFlags() are zero.
+  inline bool isLayerValid() const { return map_ && error_flags_ == 0; }
+  /// Check if the voxel reference is valid for @c data() calls.
+  /// @return True if @c isLayerValid() and the @c chunk() and @c key() values are non-null.
+  inline bool isValid() const { return isLayerValid() && chunk_ && key_ != Key::kNull; }
+
+  /// Query the pointer to the @c OccupancyMap .
+  /// @return The map pointer.
+  inline MapTypePtr map() const { return map_; }
+  /// Query the pointer to the @c MapChunk .
+  /// @return The chunk pointer.
+  inline MapChunkPtr chunk() const { return chunk_; }
+  /// Query the current @c Key reference.
+  /// @return The current key value.
+  inline Key key() const { return key_; }
+  /// Query the @c MapLayer index bound to the template type at @p layer .
+  /// @param layer The index into the template type list.
+  /// @return The map layer index.
+  inline int layerIndex(size_t layer) const { return layer_indices_[layer]; }
+  /// Query the status @c Error flag values for the set.
+  /// @return The current error flags.
+  inline unsigned errorFlags() const { return error_flags_; }
+
+  /// Set the voxel @c Key for all layers. The @c MapChunk is only resolved when the region changes and this may
+  /// create a @c MapChunk for a mutable set.
+  /// @param key The key for the voxel to reference. Must be non-null and in range.
+  /// @return `*this`
+  VoxelSet &setKey(const Key &key);
+  /// Set the voxel @c Key with a pre-resolved @c MapChunk .
+  /// @param key The key for the voxel to reference. Must be non-null and in range.
+  /// @param chunk A pointer to the correct chunk for the @c Key . This must be the correct chunk.
+  /// @return `*this`
+  VoxelSet &setKey(const Key &key, MapChunkPtr chunk);
+  /// Set the voxel reference from an @c OccupancyMap::iterator (mutable) or @c OccupancyMap::const_iterator (read
+  /// only).
+  /// @param iter The iterator to set the voxel reference from. Must be a valid voxel iterator.
+  /// @return `*this`
+  VoxelSet &setKey(const MapIteratorType &iter);
+
+  /// Access the data for the current voxel in layer @c I . Only call if @c isValid() is true.
+  /// @tparam I The index of the layer type.
+  /// @return The data for the current voxel.
+  template <size_t I>
+  DataType<I> data() const
+  {
+    DataType<I> d;
+    read<I>(&d);
+    return d;
+  }
+
+  /// Read the current voxel data for layer @c I . No error checking is performed.
+  /// @tparam I The index of the layer type.
+  /// @param[out] value Set to the voxel data.
+  /// @return The read value - i.e., `*value`.
+  template <size_t I>
+  inline const DataType<I> &read(DataType<I> *value) const
+  {
+    memcpy(value, voxel_memory_[I] + voxel_strides_[I] * voxel_indices_[I], sizeof(DataType<I>));
+    return *value;
+  }
+
+  /// Write the current voxel data for layer @c I . No error checking is performed. Only available for non-const
+  /// layer types.
+  /// @tparam I The index of the layer type.
+  /// @param value The value to write.
+  template <size_t I>
+  inline void write(const DataType<I> &value)
+  {
+    static_assert(!std::is_const<LayerType<I>>::value, "Cannot write a const VoxelSet layer");
+    memcpy(voxel_memory_[I] + voxel_strides_[I] * voxel_indices_[I], &value, sizeof(DataType<I>));
+    touched_layers_ |= (1u << I);
+    touched_voxel_ = true;
+  }
+
+  /// Return a pointer to the start of the voxel memory for layer @c I in the current chunk.
+  /// @c isValid() must be true before calling.
+  /// @tparam I The index of the layer type.
+  /// @return A pointer to the voxel memory for the currently referenced chunk.
+  template <size_t I>
+  inline VoxelDataPtr voxelMemory() const
+  {
+    return voxel_memory_[I];
+  }
+
+  /// Commit any outstanding book keeping for the current chunk while retaining the voxel reference.
+  inline void commit() { updateTouch(true); }
+
+  /// Nullify the set, releasing the current chunk after book keeping.
+  void reset();
+
+private:
+  /// Validate the layer indices against the template types.
+  void validateLayers();
+  /// Resolve the layer voxel indices for the current key.
+  void updateVoxelIndices();
+  /// Switch to @p chunk , completing book keeping for the previous chunk and retaining the new chunk layers.
+  /// @param chunk The new chunk. May be null.
+  void setChunk(MapChunkPtr chunk);
+  /// Update the @c MapChunk::first_valid_index if the current voxel has been written.
+  void updateVoxelTouch();
+  /// Complete the batched book keeping for the current chunk.
+  /// @param retain_chunk True to keep the current chunk retained, false to release it and clear the chunk.
+  void updateTouch(bool retain_chunk);
+
+  std::array<VoxelDataPtr, kLayerCount> voxel_memory_{};  ///< Voxel memory for each layer in the current chunk.
+  std::array<unsigned, kLayerCount> voxel_indices_{};     ///< Voxel index within each layer for the current key.
+  std::array<int, kLayerCount> layer_indices_{};          ///< The map layer for each template type.
+  std::array<glm::u8vec3, kLayerCount> layer_dims_{};     ///< The voxel dimensions of each layer.
+  std::array<VoxelOrder, kLayerCount> voxel_orders_{};    ///< The voxel memory order of each layer.
+  std::array<size_t, kLayerCount> voxel_strides_{ sizeof(T)... };  ///< Voxel byte stride of each layer.
+  MapTypePtr map_ = nullptr;                              ///< @c OccupancyMap pointer
+  MapChunkPtr chunk_ = nullptr;                           ///< Current @c MapChunk pointer - retained when non-null.
+  Key key_ = Key::kNull;                                  ///< Current voxel @c Key reference.
+  unsigned touched_layers_ = 0;  ///< Bit set of layers written in the current chunk.
+  bool touched_voxel_ = false;   ///< Has the current voxel been written?
+  uint16_t error_flags_ = 0;     ///< Current error flags.
+};
+
+
+template <typename... T>
+VoxelSet<T...>::VoxelSet(MapTypePtr map, const std::array<int, kLayerCount> &layer_indices)
+  : layer_indices_(layer_indices)
+  , map_(map)
+{
+  validateLayers();
+}
+
+
+template <typename... T>
+VoxelSet<T...>::VoxelSet(MapTypePtr map, const std::array<int, kLayerCount> &layer_indices, const Key &key)
+  : VoxelSet<T...>(map, layer_indices)
+{
+  if (isLayerValid())
+  {
+    setKey(key);
+  }
+}
+
+
+template <typename... T>
+VoxelSet<T...> &VoxelSet<T...>::setKey(const Key &key)
+{
+  updateVoxelTouch();
+  key_ = key;
+  if (!chunk_ || chunk_->region.coord != key.regionKey())
+  {
+    // Create chunk if not read only access.
+    setChunk(detail::VoxelSetAccess<kReadOnly>::chunk(map_, key));
+  }
+  updateVoxelIndices();
+  return *this;
+}
+
+
+template <typename... T>
+VoxelSet<T...> &VoxelSet<T...>::setKey(const Key &key, MapChunkPtr chunk)
+{
+  updateVoxelTouch();
+  key_ = key;
+  setChunk(chunk);
+  updateVoxelIndices();
+  return *this;
+}
+
+
+template <typename... T>
+VoxelSet<T...> &VoxelSet<T...>::setKey(const MapIteratorType &iter)
+{
+  return setKey(*iter, iter.chunk());
+}
+
+
+template <typename... T>
+void VoxelSet<T...>::reset()
+{
+  updateTouch(false);
+  key_ = Key::kNull;
+}
+
+
+template <typename... T>
+void VoxelSet<T...>::validateLayers()
+{
+  if (!map_)
+  {
+    error_flags_ |= unsigned(Error::kNullMap);
+    return;
+  }
+
+  const std::array<size_t, kLayerCount> voxel_sizes = { sizeof(T)... };
+  for (size_t i = 0; i < kLayerCount; ++i)
+  {
+    const MapLayer *layer = (layer_indices_[i] >= 0) ? map_->layout().layerPtr(layer_indices_[i]) : nullptr;
+    if (!layer)
+    {
+      error_flags_ |= unsigned(Error::kInvalidLayerIndex);
+    }
+    else if (layer->voxelByteSize() != voxel_sizes[i])
+    {
+      error_flags_ |= unsigned(Error::kVoxelSizeMismatch);
+    }
+    else
+    {
+      layer_dims_[i] = layer->dimensions(map_->regionVoxelDimensions());
+      voxel_orders_[i] = resolveVoxelOrder(map_->voxelOrder(), layer_dims_[i]);
+      voxel_strides_[i] = layer->voxelStride();
+    }
+  }
+}
+
+
+template <typename... T>
+void VoxelSet<T...>::updateVoxelIndices()
+{
+  for (size_t i = 0; i < kLayerCount; ++i)
+  {
+    voxel_indices_[i] = ohm::voxelIndex(key_, layer_dims_[i], voxel_orders_[i]);
+  }
+}
+
+
+template <typename... T>
+void VoxelSet<T...>::setChunk(MapChunkPtr chunk)
+{
+  if (chunk_ != chunk)
+  {
+    updateTouch(false);
+    chunk_ = chunk;
+    if (chunk_)
+    {
+      for (size_t i = 0; i < kLayerCount; ++i)
+      {
+        chunk_->voxel_blocks[layer_indices_[i]]->retain();
+        voxel_memory_[i] = chunk_->voxel_blocks[layer_indices_[i]]->voxelBytes();
+      }
+    }
+  }
+}
+
+
+template <typename... T>
+void VoxelSet<T...>::updateVoxelTouch()
+{
+  if (touched_voxel_ && chunk_)
+  {
+    detail::VoxelSetAccess<kReadOnly>::touch(chunk_, ohm::voxelIndex(key_, map_->regionVoxelDimensions()));
+  }
+  touched_voxel_ = false;
+}
+
+
+template <typename... T>
+void VoxelSet<T...>::updateTouch(bool retain_chunk)
+{
+  updateVoxelTouch();
+  if (map_ && chunk_)
+  {
+    if (touched_layers_)
+    {
+      detail::VoxelSetAccess<kReadOnly>::touch(map_, chunk_, layer_indices_, touched_layers_);
+    }
+    if (!retain_chunk)
+    {
+      for (size_t i = 0; i < kLayerCount; ++i)
+      {
+        chunk_->voxel_blocks[layer_indices_[i]]->release();
+        voxel_memory_[i] = nullptr;
+      }
+      chunk_ = nullptr;
+    }
+  }
+  touched_layers_ = 0;
+}
+}  // namespace ohm
+
+#endif  // OHMVOXELSET_H
@@ -0,0 +1,270 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELSPAN_H
+#define OHM_VOXELSPAN_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "MapChunk.h"
+#include "MapLayer.h"
+#include "MapLayout.h"
+#include "OccupancyMap.h"
+#include "ParallelForEach.h"
+#include "RegionIndexer.h"
+#include "VoxelBlock.h"
+#include "VoxelBuffer.h"
+#include "VoxelOrder.h"
+
+#include <glm/vec3.hpp>
+
+#include <cinttypes>
+#include <type_traits>
+
+namespace ohm
+{
+/// Converts linear voxel memory indices within a @c MapChunk layer into voxel @c Key values and back.
+///
+/// The indices match the layer memory addressed by a @c VoxelSpan , honouring the layer's @c VoxelOrder . Row major
+/// layers decode using a @c RegionIndexer , so power of two layer dimensions avoid division.
+class VoxelKeyDecoder
+{
+public:
+  /// Default constructor: decodes nothing.
+  VoxelKeyDecoder() = default;
+  /// Create a decoder for a layer in the region at @p region_coord .
+  /// @param region_coord The @c MapRegion::coord of the chunk.
+  /// @param layer_dim The layer voxel dimensions.
+  /// @param order The layer voxel order - see @c OccupancyMap::layerVoxelOrder() .
+  inline VoxelKeyDecoder(const glm::i16vec3 &region_coord, const glm::u8vec3 &layer_dim, VoxelOrder order)
+    : region_coord_(region_coord)
+    , layer_dim_(layer_dim)
+    , order_(order)
+    , indexer_(glm::ivec3(layer_dim))
+  {}
+
+  /// Query the region coordinate.
+  /// @return The region coordinate of the chunk.
+  inline const glm::i16vec3 &regionCoord() const { return region_coord_; }
+  /// Query the layer voxel dimensions.
+  /// @return The layer voxel dimensions.
+  inline const glm::u8vec3 &layerDim() const { return layer_dim_; }
+  /// Query the layer voxel order.
+  /// @return The layer voxel order.
+  inline VoxelOrder order() const { return order_; }
+
+  /// Decode the local key for the voxel at @p index .
+  /// @param index The voxel memory index.
+  /// @return The local voxel key.
+  inline glm::u8vec3 localKey(size_t index) const
+  {
+    return (order_ == VoxelOrder::kRowMajor) ? indexer_.localKey(unsigned(index)) :
+                                               voxelLocalKey(unsigned(index), layer_dim_, order_);
+  }
+  /// Decode the @c Key for the voxel at @p index .
+  /// @param index The voxel memory index.
+  /// @return The voxel key.
+  inline Key key(size_t index) const { return Key(region_coord_, localKey(index)); }
+  /// Encode a local key into a voxel memory index.
+  /// @param local_key The local voxel key.
+  /// @return The voxel memory index.
+  inline unsigned index(const glm::u8vec3 &local_key) const
+  {
+    return (order_ == VoxelOrder::kRowMajor) ? indexer_.index(local_key) : voxelIndex(local_key, layer_dim_, order_);
+  }
+
+private:
+  glm::i16vec3 region_coord_{ 0, 0, 0 };
+  glm::u8vec3 layer_dim_{ 0, 0, 0 };
+  VoxelOrder order_ = VoxelOrder::kRowMajor;
+  RegionIndexer indexer_;
+};
+
+/// A typed view of the contiguous voxel memory of one @c MapLayer in one @c MapChunk .
+///
+/// A @c VoxelSpan supports bulk operations - thresholding, decay, export - as linear passes over the layer memory
+/// rather than stepping an @c OccupancyMap::iterator one voxel at a time. The span retains the layer's @c VoxelBlock
+/// for its lifetime so the memory remains uncompressed. Voxels are in layer memory order which may be decoded into
+/// a @c Key using the @c keyDecoder() .
+///
+/// The span is read only when @c T is @c const . Modifying the memory of a mutable span bypasses the @c Voxel book
+/// keeping, so the user must call @c touch() once done. The @c MapChunk::first_valid_index is not updated, so a span
+/// should not be used to mark unobserved occupancy voxels as observed.
+///
+/// The span is invalid - empty - if the layer does not exist or its voxel size does not match @c T .
+///
+/// @code
+/// // Clamp all observed occupancy values in a chunk.
+/// ohm::VoxelSpan<float> occupancy(chunk, map, map.layout().occupancyLayer());
+/// const float limit = 0.5f * map.maxVoxelValue();
+/// for (float &value : occupancy)
+/// {
+///   if (!ohm::isUnobserved(value))
+///   {
+///     value = std::min(value, limit);
+///   }
+/// }
+/// occupancy.touch(map.touch());
+/// @endcode
+///
+/// @tparam T The voxel data type. Must exactly match the layer voxel size.
+template <typename T>
+class VoxelSpan
+{
+public:
+  /// Non-const voxel data type.
+  using DataType = typename std::remove_const<T>::type;
+  /// Const or non-const @c VoxelBlock matching the constness of @c T .
+  using BlockType = typename std::conditional<std::is_const<T>::value, const VoxelBlock, VoxelBlock>::type;
+  /// Const or non-const @c MapChunk pointer matching the constness of @c T .
+  using MapChunkPtr = typename std::conditional<std::is_const<T>::value, const MapChunk *, MapChunk *>::type;
+
+  /// Default constructor: creates an empty span.
+  VoxelSpan() = default;
+  /// Create a span over @p layer_index in @p chunk .
+  /// @param chunk The chunk to view. Must belong to @p map .
+  /// @param map The map owning the chunk.
+  /// @param layer_index The @c MapLayer to view.
+  VoxelSpan(MapChunkPtr chunk, const OccupancyMap &map, int layer_index);
+
+  /// Is this a valid, non-empty span?
+  /// @return True when valid.
+  inline bool isValid() const { return data_ != nullptr; }
+  /// Query the number of voxels in the span.
+  /// @return The voxel count.
+  inline size_t size() const { return size_; }
+  /// Is the span empty?
+  /// @return True if there are no voxels.
+  inline bool empty() const { return size_ == 0; }
+
+  /// Access the voxel memory.
+  /// @return The start of the voxel memory.
+  inline T *data() const { return data_; }
+  /// Iteration start.
+  /// @return The start of the voxel memory.
+  inline T *begin() const { return data_; }
+  /// Iteration end.
+  /// @return The end of the voxel memory.
+  inline T *end() const { return data_ + size_; }
+  /// Access the voxel at @p index . No bounds checking.
+  /// @param index The voxel memory index.
+  /// @return The voxel at @p index .
+  inline T &operator[](size_t index) const { return data_[index]; }
+
+  /// Query the viewed chunk.
+  /// @return The chunk.
+  inline MapChunkPtr chunk() const { return chunk_; }
+  /// Query the viewed layer index.
+  /// @return The map layer index.
+  inline int layerIndex() const { return layer_index_; }
+  /// Access the key decoder for the viewed layer.
+  /// @return The key decoder.
+  inline const VoxelKeyDecoder &keyDecoder() const { return decoder_; }
+
+  /// Mark the chunk layer as modified, setting the @c MapChunk::dirty_stamp and the layer's
+  /// @c MapChunk::touched_stamps to @p stamp . Only available for mutable spans.
+  /// @param stamp The stamp value, generally from @c OccupancyMap::touch() .
+  void touch(uint64_t stamp);
+
+private:
+  VoxelBuffer<BlockType> buffer_;  ///< Retains the layer voxel memory.
+  T *data_ = nullptr;
+  size_t size_ = 0;
+  MapChunkPtr chunk_ = nullptr;
+  int layer_index_ = -1;
+  VoxelKeyDecoder decoder_;
+};
+
+
+template <typename T>
+VoxelSpan<T>::VoxelSpan(MapChunkPtr chunk, const OccupancyMap &map, int layer_index)
+  : chunk_(chunk)
+  , layer_index_(layer_index)
+{
+  const MapLayer *layer = (chunk && layer_index >= 0) ? map.layout().layerPtr(layer_index) : nullptr;
+  // Group member layers are interleaved with the other group members so cannot be addressed as a T array.
+  if (layer && layer->voxelByteSize() == sizeof(T) && !layer->isGroupMember())
+  {
+    const glm::u8vec3 layer_dim = layer->dimensions(map.regionVoxelDimensions());
+    buffer_ = VoxelBuffer<BlockType>(chunk->voxel_blocks[layer_index]);
+    // Layer memory is allocated for the layer data type so may be addressed as T.
+    data_ = reinterpret_cast<T *>(buffer_.voxelMemory());  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    size_ = size_t(layer_dim.x) * size_t(layer_dim.y) * size_t(layer_dim.z);
+    decoder_ = VoxelKeyDecoder(chunk->region.coord, layer_dim, map.layerVoxelOrder(layer_index));
+  }
+}
+
+
+template <typename T>
+void VoxelSpan<T>::touch(uint64_t stamp)
+{
+  static_assert(!std::is_const<T>::value, "Cannot touch a const VoxelSpan");
+  if (chunk_ && layer_index_ >= 0)
+  {
+    chunk_->markDirty(stamp);
+    chunk_->touched_stamps[layer_index_].store(stamp, std::memory_order_relaxed);
+  }
+}
+
+
+/// Visit a read only @c VoxelSpan of @p layer_index for every region in @p map , potentially in parallel - see
+/// @c parallelForEachRegion() .
+///
+/// @param map The map to visit.
+/// @param layer_index The layer to view.
+/// @param visit The function to invoke for each span. Must have the signature
+///   `void(const VoxelSpan<const T> &, unsigned worker_index)` .
+/// @param use_threads Allow regions to be visited in parallel?
+/// @tparam T The voxel data type.
+template <typename T, typename Func>
+void forEachVoxelSpan(const OccupancyMap &map, int layer_index, Func &&visit, bool use_threads = true)
+{
+  parallelForEachRegion(
+    map,
+    [&map, layer_index, &visit](const MapChunk &chunk, size_t /*region_index*/, unsigned worker_index)  //
+    {
+      const VoxelSpan<const T> span(&chunk, map, layer_index);
+      if (span.isValid())
+      {
+        visit(span, worker_index);
+      }
+    },
+    use_threads);
+}
+
+
+/// Visit a mutable @c VoxelSpan of @p layer_index for every region in @p map , potentially in parallel, to apply a
+/// map wide transform. Each visited span is touched with a single shared @c OccupancyMap::touch() stamp.
+///
+/// @param map The map to modify.
+/// @param layer_index The layer to view.
+/// @param visit The function to invoke for each span. Must have the signature
+///   `void(const VoxelSpan<T> &, unsigned worker_index)` .
+/// @param use_threads Allow regions to be visited in parallel?
+/// @tparam T The voxel data type. Must not be const.
+template <typename T, typename Func>
+void transformVoxelSpans(OccupancyMap &map, int layer_index, Func &&visit, bool use_threads = true)
+{
+  static_assert(!std::is_const<T>::value, "transformVoxelSpans() requires a mutable type");
+  const uint64_t stamp = map.touch();
+  parallelForEachRegion(
+    map,
+    [&map, layer_index, stamp, &visit](const MapChunk &chunk, size_t /*region_index*/, unsigned worker_index)  //
+    {
+      // The map is mutable, so its chunks are too.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      VoxelSpan<T> span(const_cast<MapChunk *>(&chunk), map, layer_index);
+      if (span.isValid())
+      {
+        visit(static_cast<const VoxelSpan<T> &>(span), worker_index);
+        span.touch(stamp);
+      }
+    },
+    use_threads);
+}
+}  // namespace ohm
+
+#endif  // OHM_VOXELSPAN_H
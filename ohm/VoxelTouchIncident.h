@@ -0,0 +1,45 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXEL_TOUCH_INCIDENT_H
+#define OHM_VOXEL_TOUCH_INCIDENT_H
+
+#include "OhmConfig.h"
+
+#include "VoxelIncident.h"
+#include "VoxelTouchTime.h"
+
+#include <cinttypes>
+
+namespace ohm
+{
+/// Packed voxel touch time and incident normal, stored in the @c default_layer::touchIncidentLayerName() layer.
+///
+/// This combines the data of the @c default_layer::touchTimeLayerName() and
+/// @c default_layer::incidentNormalLayerName() layers so a sample update touches one record rather than one per
+/// layer. The members use the same encoding as the individual layers.
+struct VoxelTouchIncident
+{
+  /// Touch time encoded by @c encodeVoxelTouchTime() .
+  uint32_t touch_time;
+  /// Incident normal encoded by @c encodeNormal() .
+  uint32_t packed_normal;
+};
+
+/// Update a @c VoxelTouchIncident for a sample.
+/// @param voxel The voxel to update.
+/// @param incident_ray The ray from the sample back to the ray origin.
+/// @param sample_count The number of samples in the voxel before this one.
+/// @param touch_time The encoded touch time. See @c encodeVoxelTouchTime() .
+/// @param update_touch_time Update the @c VoxelTouchIncident::touch_time ? False when there is no timestamp.
+inline void updateTouchIncident(VoxelTouchIncident *voxel, const glm::vec3 &incident_ray, unsigned sample_count,
+                                unsigned touch_time, bool update_touch_time)
+{
+  voxel->touch_time = (update_touch_time) ? touch_time : voxel->touch_time;
+  voxel->packed_normal = updateIncidentNormal(voxel->packed_normal, incident_ray, sample_count);
+}
+}  // namespace ohm
+
+#endif  // OHM_VOXEL_TOUCH_INCIDENT_H
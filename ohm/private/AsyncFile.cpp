@@ -0,0 +1,692 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "AsyncFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+#else  // _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+#if defined(OHM_FEATURE_URING) && defined(__linux__)
+#include <liburing.h>
+#include <sys/uio.h>
+#define OHM_ASYNC_URING 1
+#endif  // defined(OHM_FEATURE_URING) && defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ohm
+{
+// Out of class definitions for ODR use under C++14.
+constexpr unsigned AsyncFile::kDefaultBufferCount;
+constexpr size_t AsyncFile::kDefaultBufferSize;
+
+namespace
+{
+/// The state of the operation on a single buffer.
+struct AsyncRequest
+{
+  uint8_t *data = nullptr;
+  size_t byte_count = 0;
+  uint64_t offset = 0;
+  /// Bytes transferred so far. Short transfers are continued until complete.
+  size_t transferred = 0;
+  bool write = false;
+  /// Submitted, but not yet waited on by @c AsyncFile::wait() .
+  bool pending = false;
+  /// Completed by the backend, successfully or otherwise.
+  bool done = false;
+  bool failed = false;
+};
+
+/// Backend interface. A backend processes the @c AsyncRequest objects owned by the @c AsyncFileDetail , indexed by
+/// buffer.
+class AsyncIo
+{
+public:
+  virtual ~AsyncIo() = default;
+
+  /// Query the backend type.
+  virtual AsyncFileBackend type() const = 0;
+
+  /// Start, or continue, the request at @p index .
+  /// @return False if the request could not be submitted.
+  virtual bool submit(unsigned index) = 0;
+
+  /// Block until the request at @p index is done.
+  virtual void wait(unsigned index) = 0;
+};
+
+#ifndef _WIN32
+int openFile(const std::string &path, unsigned flags)
+{
+  int open_flags = O_RDONLY;
+  if (flags & kAfWrite)
+  {
+    open_flags = ((flags & kAfRead) ? O_RDWR : O_WRONLY) | O_CREAT;
+    if (flags & kAfTruncate)
+    {
+      open_flags |= O_TRUNC;
+    }
+  }
+  return ::open(path.c_str(), open_flags | O_CLOEXEC, 0644);  // NOLINT(hicpp-signed-bitwise)
+}
+
+
+/// Synchronously complete the remainder of @p request using positional I/O.
+void transfer(int fd, AsyncRequest &request)
+{
+  while (request.transferred < request.byte_count)
+  {
+    uint8_t *data = request.data + request.transferred;
+    const size_t remaining = request.byte_count - request.transferred;
+    const auto offset = off_t(request.offset + request.transferred);
+    const ssize_t result =
+      (request.write) ? ::pwrite(fd, data, remaining, offset) : ::pread(fd, data, remaining, offset);
+    if (result < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      request.failed = true;
+      return;
+    }
+
+    if (result == 0)
+    {
+      // End of file on read. A write making no progress is an error.
+      request.failed = request.write;
+      return;
+    }
+
+    request.transferred += size_t(result);
+  }
+}
+
+
+/// Backend issuing positional reads and writes from a small pool of I/O threads.
+class ThreadedIo : public AsyncIo
+{
+public:
+  static constexpr unsigned kMaxThreads = 4u;
+
+  ThreadedIo(int fd, std::vector<AsyncRequest> &requests)
+    : fd_(fd)
+    , requests_(requests)
+  {
+    const unsigned thread_count = std::min(unsigned(requests.size()), kMaxThreads);
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+      threads_.emplace_back([this]() { run(); });
+    }
+  }
+
+  ~ThreadedIo() override
+  {
+    {
+      std::unique_lock<std::mutex> guard(mutex_);
+      quit_ = true;
+    }
+    submit_cv_.notify_all();
+    for (auto &thread : threads_)
+    {
+      thread.join();
+    }
+  }
+
+  AsyncFileBackend type() const override { return AsyncFileBackend::kThreaded; }
+
+  bool submit(unsigned index) override
+  {
+    {
+      std::unique_lock<std::mutex> guard(mutex_);
+      queue_.emplace_back(index);
+    }
+    submit_cv_.notify_one();
+    return true;
+  }
+
+  void wait(unsigned index) override
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    done_cv_.wait(guard, [this, index]() { return requests_[index].done; });
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    while (true)
+    {
+      submit_cv_.wait(guard, [this]() { return quit_ || !queue_.empty(); });
+      if (queue_.empty())
+      {
+        return;
+      }
+
+      const unsigned index = queue_.front();
+      queue_.pop_front();
+      guard.unlock();
+      transfer(fd_, requests_[index]);
+      guard.lock();
+      requests_[index].done = true;
+      done_cv_.notify_all();
+    }
+  }
+
+  int fd_;
+  std::vector<AsyncRequest> &requests_;
+  std::vector<std::thread> threads_;
+  std::deque<unsigned> queue_;
+  std::mutex mutex_;
+  std::condition_variable submit_cv_;
+  std::condition_variable done_cv_;
+  bool quit_ = false;
+};
+
+constexpr unsigned ThreadedIo::kMaxThreads;
+#endif  // _WIN32
+
+#ifdef OHM_ASYNC_URING
+/// Linux io_uring backend. The buffers are registered with the ring when possible, avoiding the kernel mapping the
+/// buffer pages for each operation.
+class UringIo : public AsyncIo
+{
+public:
+  UringIo(int fd, std::vector<AsyncRequest> &requests)
+    : fd_(fd)
+    , requests_(requests)
+    , iovecs_(requests.size())
+  {}
+
+  ~UringIo() override
+  {
+    if (initialised_)
+    {
+      io_uring_queue_exit(&ring_);
+    }
+  }
+
+  /// Create the ring, sized for one operation per buffer, and register the buffers.
+  /// @return False if io_uring is unavailable.
+  bool init(uint8_t *memory, size_t buffer_size)
+  {
+    if (io_uring_queue_init(unsigned(requests_.size()), &ring_, 0) < 0)
+    {
+      return false;
+    }
+    initialised_ = true;
+
+    std::vector<iovec> buffers(requests_.size());
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+      buffers[i].iov_base = memory + i * buffer_size;
+      buffers[i].iov_len = buffer_size;
+    }
+    // Registration may fail under a low RLIMIT_MEMLOCK. Fall back to unregistered operations.
+    registered_ = io_uring_register_buffers(&ring_, buffers.data(), unsigned(buffers.size())) == 0;
+    return true;
+  }
+
+  AsyncFileBackend type() const override { return AsyncFileBackend::kIoUring; }
+
+  bool submit(unsigned index) override
+  {
+    io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+    if (!sqe)
+    {
+      // Cannot happen with one request per buffer.
+      return false;
+    }
+
+    AsyncRequest &request = requests_[index];
+    uint8_t *data = request.data + request.transferred;
+    const auto byte_count = unsigned(request.byte_count - request.transferred);
+    const uint64_t offset = request.offset + request.transferred;
+    if (registered_)
+    {
+      if (request.write)
+      {
+        io_uring_prep_write_fixed(sqe, fd_, data, byte_count, offset, int(index));
+      }
+      else
+      {
+        io_uring_prep_read_fixed(sqe, fd_, data, byte_count, offset, int(index));
+      }
+    }
+    else
+    {
+      iovec &iov = iovecs_[index];
+      iov.iov_base = data;
+      iov.iov_len = byte_count;
+      if (request.write)
+      {
+        io_uring_prep_writev(sqe, fd_, &iov, 1, offset);
+      }
+      else
+      {
+        io_uring_prep_readv(sqe, fd_, &iov, 1, offset);
+      }
+    }
+    // NOLINTNEXTLINE(performance-no-int-to-ptr)
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(uintptr_t(index)));
+    return io_uring_submit(&ring_) >= 0;
+  }
+
+  void wait(unsigned index) override
+  {
+    // Completions arrive in any order. Process all completions until the request of interest is done.
+    while (!requests_[index].done)
+    {
+      io_uring_cqe *cqe = nullptr;
+      const int ret = io_uring_wait_cqe(&ring_, &cqe);
+      if (ret == -EINTR)
+      {
+        continue;
+      }
+
+      if (ret < 0)
+      {
+        // The ring is unusable. Fail everything in flight.
+        for (auto &request : requests_)
+        {
+          if (request.pending && !request.done)
+          {
+            request.failed = request.done = true;
+          }
+        }
+        return;
+      }
+
+      const auto completed = unsigned(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(cqe)));
+      const int result = cqe->res;
+      io_uring_cqe_seen(&ring_, cqe);
+      complete(completed, result);
+    }
+  }
+
+private:
+  /// Handle a completion @p result for the request at @p index , continuing short transfers.
+  void complete(unsigned index, int result)
+  {
+    AsyncRequest &request = requests_[index];
+    if (result == -EINTR || result == -EAGAIN)
+    {
+      // Retry.
+      result = 0;
+    }
+    else if (result < 0 || (result == 0 && request.write))
+    {
+      request.failed = request.done = true;
+      return;
+    }
+    else if (result == 0)
+    {
+      // End of file.
+      request.done = true;
+      return;
+    }
+
+    request.transferred += size_t(result);
+    if (request.transferred >= request.byte_count)
+    {
+      request.done = true;
+    }
+    else if (!submit(index))
+    {
+      request.failed = request.done = true;
+    }
+  }
+
+  io_uring ring_{};
+  int fd_;
+  std::vector<AsyncRequest> &requests_;
+  /// Per request vectors for unregistered operations. Must remain valid until submitted.
+  std::vector<iovec> iovecs_;
+  bool initialised_ = false;
+  bool registered_ = false;
+};
+#endif  // OHM_ASYNC_URING
+
+#ifdef _WIN32
+/// Windows overlapped I/O backend.
+class OverlappedIo : public AsyncIo
+{
+public:
+  OverlappedIo(HANDLE file, std::vector<AsyncRequest> &requests)
+    : file_(file)
+    , requests_(requests)
+    , overlapped_(requests.size())
+    , events_(requests.size())
+  {
+    for (auto &event : events_)
+    {
+      event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    }
+  }
+
+  ~OverlappedIo() override
+  {
+    for (auto &event : events_)
+    {
+      CloseHandle(event);
+    }
+  }
+
+  AsyncFileBackend type() const override { return AsyncFileBackend::kOverlapped; }
+
+  bool submit(unsigned index) override
+  {
+    AsyncRequest &request = requests_[index];
+    OVERLAPPED &overlapped = overlapped_[index];
+    std::memset(&overlapped, 0, sizeof(overlapped));
+    const uint64_t offset = request.offset + request.transferred;
+    overlapped.Offset = DWORD(offset & 0xffffffffu);
+    overlapped.OffsetHigh = DWORD(offset >> 32u);
+    overlapped.hEvent = events_[index];
+
+    uint8_t *data = request.data + request.transferred;
+    const auto byte_count = DWORD(request.byte_count - request.transferred);
+    const BOOL ok = (request.write) ? WriteFile(file_, data, byte_count, nullptr, &overlapped) :
+                                      ReadFile(file_, data, byte_count, nullptr, &overlapped);
+    if (!ok)
+    {
+      const DWORD error = GetLastError();
+      if (error == ERROR_HANDLE_EOF && !request.write)
+      {
+        request.done = true;
+        return true;
+      }
+      return error == ERROR_IO_PENDING;
+    }
+    return true;
+  }
+
+  void wait(unsigned index) override
+  {
+    AsyncRequest &request = requests_[index];
+    while (!request.done)
+    {
+      DWORD transferred = 0;
+      if (!GetOverlappedResult(file_, &overlapped_[index], &transferred, TRUE))
+      {
+        request.failed = request.write || GetLastError() != ERROR_HANDLE_EOF;
+        request.done = true;
+        return;
+      }
+
+      request.transferred += transferred;
+      if (transferred == 0 || request.transferred >= request.byte_count)
+      {
+        // Complete or end of file. A write making no progress is an error.
+        request.failed = transferred == 0 && request.write;
+        request.done = true;
+      }
+      else if (!submit(index))
+      {
+        request.failed = request.done = true;
+      }
+    }
+  }
+
+private:
+  HANDLE file_;
+  std::vector<AsyncRequest> &requests_;
+  std::vector<OVERLAPPED> overlapped_;
+  std::vector<HANDLE> events_;
+};
+#endif  // _WIN32
+}  // namespace
+
+
+struct AsyncFileDetail
+{
+  /// Memory for all buffers.
+  std::vector<uint8_t> memory;
+  /// Operation state for each buffer.
+  std::vector<AsyncRequest> requests;
+  std::unique_ptr<AsyncIo> io;
+  size_t buffer_size = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+#else   // _WIN32
+  int fd = -1;
+#endif  // _WIN32
+};
+
+
+namespace
+{
+bool submitRequest(AsyncFileDetail &imp, unsigned buffer_index, size_t byte_count, uint64_t offset, bool write)
+{
+  if (!imp.io || buffer_index >= imp.requests.size() || imp.requests[buffer_index].pending)
+  {
+    return false;
+  }
+
+  AsyncRequest &request = imp.requests[buffer_index];
+  request = AsyncRequest();
+  request.data = imp.memory.data() + size_t(buffer_index) * imp.buffer_size;
+  request.byte_count = std::min(byte_count, imp.buffer_size);
+  request.offset = offset;
+  request.write = write;
+  request.pending = true;
+  if (request.byte_count == 0)
+  {
+    request.done = true;
+    return true;
+  }
+
+  if (!imp.io->submit(buffer_index))
+  {
+    request = AsyncRequest();
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+
+AsyncFile::AsyncFile()
+  : imp_(std::make_unique<AsyncFileDetail>())
+{}
+
+
+AsyncFile::~AsyncFile()
+{
+  close();
+}
+
+
+bool AsyncFile::open(const std::string &path, unsigned flags, unsigned buffer_count, size_t buffer_size)
+{
+  close();
+  if (buffer_count == 0 || buffer_size == 0 || !(flags & (kAfRead | kAfWrite)))
+  {
+    return false;
+  }
+
+#ifdef _WIN32
+  DWORD access = 0;
+  DWORD disposition = OPEN_EXISTING;
+  if (flags & kAfRead)
+  {
+    access |= GENERIC_READ;
+  }
+  if (flags & kAfWrite)
+  {
+    access |= GENERIC_WRITE;
+    disposition = (flags & kAfTruncate) ? CREATE_ALWAYS : OPEN_ALWAYS;
+  }
+  HANDLE file = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, disposition,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+  if (file == INVALID_HANDLE_VALUE)  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  {
+    return false;
+  }
+  imp_->file = file;
+#else   // _WIN32
+  const int fd = openFile(path, flags);
+  if (fd < 0)
+  {
+    return false;
+  }
+  imp_->fd = fd;
+#endif  // _WIN32
+
+  imp_->buffer_size = buffer_size;
+  imp_->memory.resize(buffer_count * buffer_size);
+  imp_->requests.resize(buffer_count);
+
+#ifdef _WIN32
+  imp_->io = std::make_unique<OverlappedIo>(imp_->file, imp_->requests);
+#else  // _WIN32
+#ifdef OHM_ASYNC_URING
+  auto uring = std::make_unique<UringIo>(imp_->fd, imp_->requests);
+  if (uring->init(imp_->memory.data(), buffer_size))
+  {
+    imp_->io = std::move(uring);
+  }
+#endif  // OHM_ASYNC_URING
+  if (!imp_->io)
+  {
+    imp_->io = std::make_unique<ThreadedIo>(imp_->fd, imp_->requests);
+  }
+#endif  // _WIN32
+
+  return true;
+}
+
+
+void AsyncFile::close()
+{
+  if (!isOpen())
+  {
+    return;
+  }
+
+  waitAll();
+  imp_->io.reset();
+#ifdef _WIN32
+  CloseHandle(imp_->file);
+  imp_->file = INVALID_HANDLE_VALUE;  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+#else   // _WIN32
+  ::close(imp_->fd);
+  imp_->fd = -1;
+#endif  // _WIN32
+  imp_->requests.clear();
+  imp_->memory = std::vector<uint8_t>();
+  imp_->buffer_size = 0;
+}
+
+
+bool AsyncFile::isOpen() const
+{
+  return imp_->io != nullptr;
+}
+
+
+AsyncFileBackend AsyncFile::backend() const
+{
+  return (imp_->io) ? imp_->io->type() : AsyncFileBackend::kNone;
+}
+
+
+unsigned AsyncFile::bufferCount() const
+{
+  return unsigned(imp_->requests.size());
+}
+
+
+size_t AsyncFile::bufferSize() const
+{
+  return imp_->buffer_size;
+}
+
+
+uint8_t *AsyncFile::buffer(unsigned buffer_index)
+{
+  return imp_->memory.data() + size_t(buffer_index) * imp_->buffer_size;
+}
+
+
+uint64_t AsyncFile::fileSize() const
+{
+  if (!isOpen())
+  {
+    return 0u;
+  }
+
+#ifdef _WIN32
+  LARGE_INTEGER file_size;
+  return (GetFileSizeEx(imp_->file, &file_size)) ? uint64_t(file_size.QuadPart) : 0u;
+#else   // _WIN32
+  struct stat file_stat = {};
+  return (fstat(imp_->fd, &file_stat) == 0) ? uint64_t(file_stat.st_size) : 0u;
+#endif  // _WIN32
+}
+
+
+bool AsyncFile::submitWrite(unsigned buffer_index, size_t byte_count, uint64_t offset)
+{
+  return submitRequest(*imp_, buffer_index, byte_count, offset, true);
+}
+
+
+bool AsyncFile::submitRead(unsigned buffer_index, size_t byte_count, uint64_t offset)
+{
+  return submitRequest(*imp_, buffer_index, byte_count, offset, false);
+}
+
+
+bool AsyncFile::pending(unsigned buffer_index) const
+{
+  return buffer_index < bufferCount() && imp_->requests[buffer_index].pending;
+}
+
+
+std::ptrdiff_t AsyncFile::wait(unsigned buffer_index)
+{
+  if (!pending(buffer_index))
+  {
+    return 0;
+  }
+
+  // The backend synchronises access to the request state.
+  imp_->io->wait(buffer_index);
+  AsyncRequest &request = imp_->requests[buffer_index];
+  request.pending = false;
+  return (!request.failed) ? std::ptrdiff_t(request.transferred) : -1;
+}
+
+
+bool AsyncFile::waitAll()
+{
+  bool ok = true;
+  for (unsigned i = 0; i < bufferCount(); ++i)
+  {
+    ok = wait(i) >= 0 && ok;
+  }
+  return ok;
+}
+}  // namespace ohm
@@ -0,0 +1,146 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_ASYNCFILE_H
+#define OHM_ASYNCFILE_H
+
+#include "OhmConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ohm
+{
+struct AsyncFileDetail;
+
+/// Flags for use with @c AsyncFile::open() .
+enum AsyncFileFlag : unsigned
+{
+  /// Open for reading.
+  kAfRead = (1u << 0u),
+  /// Open for writing, creating the file if required.
+  kAfWrite = (1u << 1u),
+  /// Truncate the file on opening. Only valid with @c kAfWrite .
+  kAfTruncate = (1u << 2u),
+};
+
+/// The I/O mechanism used by an @c AsyncFile .
+enum class AsyncFileBackend : int
+{
+  /// Not open.
+  kNone = 0,
+  /// Positional reads and writes (`pread()`/`pwrite()`) issued by a small pool of I/O threads.
+  kThreaded,
+  /// Linux io_uring with registered buffers. Requires @c OHM_FEATURE_URING and kernel support.
+  kIoUring,
+  /// Windows overlapped I/O.
+  kOverlapped
+};
+
+/// A file supporting multiple reads and writes in flight at once.
+///
+/// The file owns a fixed set of equally sized buffers and each buffer may have one read or write in flight. Data are
+/// written by filling a @c buffer() then calling @c submitWrite() , while reads are started with @c submitRead() .
+/// Either call returns immediately and @c wait() blocks until the operation on that buffer completes. A buffer must
+/// not be modified while its operation is in flight, and @c wait() must be called before a buffer is reused.
+///
+/// The backend is selected on @c open() : io_uring with registered buffers when available on Linux, overlapped I/O on
+/// Windows and I/O threads otherwise (including when io_uring is unavailable at runtime). Operations are positional,
+/// so there is no file cursor and in flight operations may complete in any order. Overlapping writes in flight at once
+/// have undefined results.
+///
+/// This class is not thread safe; callers must serialise access. This supports the @c InputStream read ahead, the
+/// @c OutputStream write behind and the @c RegionPager .
+class AsyncFile
+{
+public:
+  /// Default number of buffers.
+  static constexpr unsigned kDefaultBufferCount = 4u;
+  /// Default buffer byte size.
+  static constexpr size_t kDefaultBufferSize = size_t(256u) * 1024u;
+
+  /// Constructor: not open.
+  AsyncFile();
+  /// Destructor: waits for outstanding operations and closes the file.
+  ~AsyncFile();
+
+  AsyncFile(const AsyncFile &) = delete;
+  AsyncFile &operator=(const AsyncFile &) = delete;
+
+  /// Open @p path and allocate the I/O buffers. Any currently open file is closed first.
+  /// @param path The file path.
+  /// @param flags @c AsyncFileFlag values.
+  /// @param buffer_count The number of buffers; the maximum number of operations in flight. Must be at least one.
+  /// @param buffer_size The byte size of each buffer.
+  /// @return True on success.
+  bool open(const std::string &path, unsigned flags, unsigned buffer_count = kDefaultBufferCount,
+            size_t buffer_size = kDefaultBufferSize);
+
+  /// Wait for all outstanding operations then close the file and release the buffers.
+  void close();
+
+  /// Check if the file is open.
+  /// @return True when open.
+  bool isOpen() const;
+
+  /// Query the backend in use.
+  /// @return The backend, @c AsyncFileBackend::kNone when not open.
+  AsyncFileBackend backend() const;
+
+  /// Query the number of buffers.
+  /// @return The buffer count, zero when not open.
+  unsigned bufferCount() const;
+
+  /// Query the byte size of each buffer.
+  /// @return The buffer size, zero when not open.
+  size_t bufferSize() const;
+
+  /// Access a buffer.
+  /// @param buffer_index The buffer index [0, @c bufferCount()).
+  /// @return The buffer memory.
+  uint8_t *buffer(unsigned buffer_index);
+
+  /// Query the current file size. Outstanding writes may not yet be included.
+  /// @return The file size (bytes).
+  uint64_t fileSize() const;
+
+  /// Start writing @p byte_count bytes from @c buffer(buffer_index) to the file at @p offset .
+  /// @param buffer_index The buffer to write. Must not have an operation in flight.
+  /// @param byte_count The number of bytes to write. Limited to @c bufferSize() .
+  /// @param offset The file offset to write at.
+  /// @return True if the write was submitted.
+  bool submitWrite(unsigned buffer_index, size_t byte_count, uint64_t offset);
+
+  /// Start reading up to @p byte_count bytes from the file at @p offset into @c buffer(buffer_index) .
+  /// @param buffer_index The buffer to read into. Must not have an operation in flight.
+  /// @param byte_count The number of bytes to read. Limited to @c bufferSize() .
+  /// @param offset The file offset to read from.
+  /// @return True if the read was submitted.
+  bool submitRead(unsigned buffer_index, size_t byte_count, uint64_t offset);
+
+  /// Check if an operation is in flight for a buffer. This does not check for completion.
+  /// @param buffer_index The buffer of interest.
+  /// @return True if an operation has been submitted and not yet waited on.
+  bool pending(unsigned buffer_index) const;
+
+  /// Wait for the operation on a buffer to complete.
+  ///
+  /// Writes either complete in full or fail. Reads may be short on reaching the end of the file.
+  /// @param buffer_index The buffer of interest.
+  /// @return The number of bytes transferred, zero if no operation was pending or -1 on failure.
+  std::ptrdiff_t wait(unsigned buffer_index);
+
+  /// Wait for all outstanding operations.
+  /// @return False if any operation failed.
+  bool waitAll();
+
+private:
+  std::unique_ptr<AsyncFileDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHM_ASYNCFILE_H
@@ -0,0 +1,426 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ChunkMap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+
+namespace ohm
+{
+// Out of line definition for ODR use in std::make_unique(), required prior to C++17.
+constexpr size_t ChunkMap::kInitialCapacity;
+
+/// A hash table slot. An empty slot has a zero @c key . A slot with a non-zero @c key and null @c chunk is a
+/// tombstone. Keys are never removed from a table once set.
+struct ChunkMap::Slot
+{
+  std::atomic<uint64_t> key{ 0 };
+  std::atomic<MapChunk *> chunk{ nullptr };
+};
+
+/// An open addressing hash table for a @c Shard .
+struct ChunkMap::Table
+{
+  /// Slot capacity. Always a power of 2.
+  const size_t capacity;
+  /// Slot array.
+  std::unique_ptr<Slot[]> slots;
+
+  explicit Table(size_t capacity)
+    : capacity(capacity)
+    , slots(std::make_unique<Slot[]>(capacity))
+  {}
+};
+
+/// A map shard. Shards are allocated separately to reduce false sharing between shards.
+struct ChunkMap::Shard
+{
+  /// The current table. Readers load this pointer.
+  std::atomic<Table *> table{ nullptr };
+  /// Number of active readers. Used to determine when retired tables may be released.
+  std::atomic<unsigned> readers{ 0 };
+  /// Number of live items.
+  std::atomic<size_t> count{ 0 };
+  /// Number of used slots (live items and tombstones) in the current table. Only accessed by writers.
+  size_t used = 0;
+  /// Write lock.
+  SpinMutex write_mutex;
+  /// Owns the current table.
+  std::unique_ptr<Table> current;
+  /// Retired tables which may still be referenced by readers.
+  std::vector<std::unique_ptr<Table>> retired;
+
+  Shard()
+    : current(std::make_unique<Table>(ChunkMap::kInitialCapacity))
+  {
+    table.store(current.get());
+  }
+};
+
+/// Scoped reader registration for a @c Shard . Holds off release of retired tables.
+class ChunkMap::ReadGuard
+{
+public:
+  explicit ReadGuard(Shard &shard)
+    : shard_(shard)
+  {
+    // Sequentially consistent ordering is required here in conjunction with the order in which the writer publishes a
+    // new table then checks the reader count.
+    shard_.readers.fetch_add(1u);
+  }
+
+  ~ReadGuard() { shard_.readers.fetch_sub(1u, std::memory_order_release); }
+
+  ReadGuard(const ReadGuard &) = delete;
+  ReadGuard &operator=(const ReadGuard &) = delete;
+
+  inline Table &table() const { return *shard_.table.load(); }
+
+private:
+  Shard &shard_;
+};
+
+
+ChunkMap::iterator::iterator(const ChunkMap *map, unsigned shard, unsigned slot)
+  : map_(map)
+  , shard_(shard)
+  , slot_(slot)
+{}
+
+
+ChunkMap::iterator &ChunkMap::iterator::operator++()
+{
+  ++slot_;
+  seekValid();
+  return *this;
+}
+
+
+void ChunkMap::iterator::seekValid()
+{
+  while (shard_ < kShardCount)
+  {
+    Shard &shard = *map_->shards_[shard_];
+    ReadGuard guard(shard);
+    const Table &table = guard.table();
+    for (; slot_ < table.capacity; ++slot_)
+    {
+      const Slot &slot = table.slots[slot_];
+      const uint64_t packed = slot.key.load(std::memory_order_acquire);
+      if (packed)
+      {
+        MapChunk *chunk = slot.chunk.load(std::memory_order_acquire);
+        if (chunk)
+        {
+          value_ = value_type(unpackKey(packed), chunk);
+          return;
+        }
+      }
+    }
+
+    ++shard_;
+    slot_ = 0;
+  }
+
+  // End.
+  shard_ = kShardCount;
+  slot_ = 0;
+  value_ = value_type();
+}
+
+
+ChunkMap::ChunkMap()
+{
+  for (auto &shard : shards_)
+  {
+    shard = std::make_unique<Shard>();
+  }
+}
+
+
+ChunkMap::~ChunkMap() = default;
+
+
+MapChunk *ChunkMap::lookup(const glm::i16vec3 &key) const
+{
+  const uint64_t packed = packKey(key);
+  const uint64_t hash = hashKey(packed);
+  Shard &shard = shardFor(hash);
+  ReadGuard guard(shard);
+  const Table &table = guard.table();
+  const size_t mask = table.capacity - 1;
+  for (size_t i = hash & mask, probe = 0; probe < table.capacity; i = (i + 1) & mask, ++probe)
+  {
+    const Slot &slot = table.slots[i];
+    const uint64_t slot_key = slot.key.load(std::memory_order_acquire);
+    if (slot_key == packed)
+    {
+      return slot.chunk.load(std::memory_order_acquire);
+    }
+
+    if (slot_key == 0)
+    {
+      return nullptr;
+    }
+  }
+
+  return nullptr;
+}
+
+
+ChunkMap::iterator ChunkMap::find(const glm::i16vec3 &key) const
+{
+  const uint64_t packed = packKey(key);
+  const uint64_t hash = hashKey(packed);
+  const unsigned shard_index = unsigned(hash >> (64u - kShardBits));
+  Shard &shard = *shards_[shard_index];
+  ReadGuard guard(shard);
+  const Table &table = guard.table();
+  const size_t mask = table.capacity - 1;
+  for (size_t i = hash & mask, probe = 0; probe < table.capacity; i = (i + 1) & mask, ++probe)
+  {
+    const Slot &slot = table.slots[i];
+    const uint64_t slot_key = slot.key.load(std::memory_order_acquire);
+    if (slot_key == packed)
+    {
+      MapChunk *chunk = slot.chunk.load(std::memory_order_acquire);
+      if (chunk)
+      {
+        iterator iter(this, shard_index, unsigned(i));
+        iter.value_ = value_type(key, chunk);
+        return iter;
+      }
+      break;
+    }
+
+    if (slot_key == 0)
+    {
+      break;
+    }
+  }
+
+  return end();
+}
+
+
+MapChunk *ChunkMap::insert(const glm::i16vec3 &key, MapChunk *chunk)
+{
+  assert(chunk);
+  const uint64_t packed = packKey(key);
+  const uint64_t hash = hashKey(packed);
+  Shard &shard = shardFor(hash);
+  std::unique_lock<SpinMutex> guard(shard.write_mutex);
+
+  Slot *slot = findWriteSlot(*shard.current, packed, hash);
+  if (slot && slot->key.load(std::memory_order_relaxed) == packed)
+  {
+    // Existing key or tombstone.
+    MapChunk *existing = slot->chunk.load(std::memory_order_relaxed);
+    if (existing)
+    {
+      return existing;
+    }
+    slot->chunk.store(chunk, std::memory_order_release);
+    shard.count.fetch_add(1u, std::memory_order_relaxed);
+    return chunk;
+  }
+
+  // New key. Ensure we have the capacity.
+  if (!slot || float(shard.used + 1) > kMaxLoadFactor * float(shard.current->capacity))
+  {
+    regrow(shard);
+    slot = findWriteSlot(*shard.current, packed, hash);
+  }
+
+  assert(slot && slot->key.load(std::memory_order_relaxed) == 0);
+  // Write the chunk first then publish the key.
+  slot->chunk.store(chunk, std::memory_order_relaxed);
+  slot->key.store(packed, std::memory_order_release);
+  ++shard.used;
+  shard.count.fetch_add(1u, std::memory_order_relaxed);
+  return chunk;
+}
+
+
+std::pair<ChunkMap::iterator, bool> ChunkMap::insert(const value_type &item)
+{
+  MapChunk *chunk = insert(item.first, item.second);
+  return std::make_pair(find(item.first), chunk == item.second);
+}
+
+
+MapChunk *ChunkMap::remove(const glm::i16vec3 &key)
+{
+  const uint64_t packed = packKey(key);
+  const uint64_t hash = hashKey(packed);
+  Shard &shard = shardFor(hash);
+  std::unique_lock<SpinMutex> guard(shard.write_mutex);
+
+  Slot *slot = findWriteSlot(*shard.current, packed, hash);
+  MapChunk *chunk = nullptr;
+  if (slot && slot->key.load(std::memory_order_relaxed) == packed)
+  {
+    // Leave the key as a tombstone.
+    chunk = slot->chunk.exchange(nullptr, std::memory_order_acq_rel);
+    if (chunk)
+    {
+      shard.count.fetch_sub(1u, std::memory_order_relaxed);
+    }
+  }
+
+  releaseRetired(shard);
+  return chunk;
+}
+
+
+ChunkMap::iterator ChunkMap::erase(const iterator &iter)
+{
+  iterator next = iter;
+  if (iter.shard_ < kShardCount)
+  {
+    remove(iter.value_.first);
+    ++next;
+  }
+  return next;
+}
+
+
+size_t ChunkMap::size() const
+{
+  size_t count = 0;
+  for (const auto &shard : shards_)
+  {
+    count += shard->count.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+
+void ChunkMap::clear()
+{
+  for (auto &shard : shards_)
+  {
+    std::unique_lock<SpinMutex> guard(shard->write_mutex);
+    shard->retired.clear();
+    shard->current = std::make_unique<Table>(kInitialCapacity);
+    shard->table.store(shard->current.get());
+    shard->used = 0;
+    shard->count = 0;
+  }
+}
+
+
+size_t ChunkMap::bucket_count() const
+{
+  size_t count = 0;
+  for (const auto &shard : shards_)
+  {
+    ReadGuard guard(*shard);
+    count += guard.table().capacity;
+  }
+  return count;
+}
+
+
+ChunkMap::iterator ChunkMap::begin() const
+{
+  iterator iter(this, 0, 0);
+  iter.seekValid();
+  return iter;
+}
+
+
+uint64_t ChunkMap::packKey(const glm::i16vec3 &key)
+{
+  // Pack the 16-bit values into the lower 48 bits and set the top bit to ensure a non-zero value.
+  return (uint64_t(uint16_t(key.x)) | (uint64_t(uint16_t(key.y)) << 16u) | (uint64_t(uint16_t(key.z)) << 32u) |
+          (uint64_t(1u) << 63u));
+}
+
+
+glm::i16vec3 ChunkMap::unpackKey(uint64_t packed)
+{
+  return glm::i16vec3(int16_t(uint16_t(packed & 0xffffu)), int16_t(uint16_t((packed >> 16u) & 0xffffu)),
+                      int16_t(uint16_t((packed >> 32u) & 0xffffu)));
+}
+
+
+uint64_t ChunkMap::hashKey(uint64_t packed)
+{
+  // splitmix64 finaliser. Spreads the key bits for both shard selection (high bits) and probing (low bits).
+  uint64_t hash = packed;
+  hash = (hash ^ (hash >> 30u)) * 0xbf58476d1ce4e5b9ull;
+  hash = (hash ^ (hash >> 27u)) * 0x94d049bb133111ebull;
+  hash = hash ^ (hash >> 31u);
+  return hash;
+}
+
+
+ChunkMap::Slot *ChunkMap::findWriteSlot(Table &table, uint64_t packed, uint64_t hash)
+{
+  const size_t mask = table.capacity - 1;
+  for (size_t i = hash & mask, probe = 0; probe < table.capacity; i = (i + 1) & mask, ++probe)
+  {
+    Slot &slot = table.slots[i];
+    const uint64_t slot_key = slot.key.load(std::memory_order_relaxed);
+    if (slot_key == packed || slot_key == 0)
+    {
+      return &slot;
+    }
+  }
+
+  return nullptr;
+}
+
+
+void ChunkMap::regrow(Shard &shard)
+{
+  // Size the new table based on the live item count, discarding tombstones. This may yield the same capacity when
+  // the table is dominated by tombstones.
+  const size_t live_count = shard.count.load(std::memory_order_relaxed);
+  size_t capacity = kInitialCapacity;
+  while (float(live_count + 1) > 0.5f * kMaxLoadFactor * float(capacity))
+  {
+    capacity *= 2;
+  }
+
+  auto new_table = std::make_unique<Table>(capacity);
+  size_t used = 0;
+  const Table &old_table = *shard.current;
+  for (size_t i = 0; i < old_table.capacity; ++i)
+  {
+    const Slot &old_slot = old_table.slots[i];
+    MapChunk *chunk = old_slot.chunk.load(std::memory_order_relaxed);
+    if (chunk)
+    {
+      const uint64_t packed = old_slot.key.load(std::memory_order_relaxed);
+      Slot *slot = findWriteSlot(*new_table, packed, hashKey(packed));
+      slot->chunk.store(chunk, std::memory_order_relaxed);
+      slot->key.store(packed, std::memory_order_relaxed);
+      ++used;
+    }
+  }
+
+  // Publish the new table. Sequentially consistent ordering is required here (see ReadGuard).
+  shard.table.store(new_table.get());
+  shard.retired.emplace_back(std::move(shard.current));
+  shard.current = std::move(new_table);
+  shard.used = used;
+
+  releaseRetired(shard);
+}
+
+
+void ChunkMap::releaseRetired(Shard &shard)
+{
+  // Any reader which registers after this point will see the current table. See ReadGuard.
+  if (!shard.retired.empty() && shard.readers.load() == 0)
+  {
+    shard.retired.clear();
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,230 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_CHUNKMAP_H
+#define OHM_CHUNKMAP_H
+
+#include "OhmConfig.h"
+
+#include "ohm/Mutex.h"
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace ohm
+{
+struct MapChunk;
+
+/// A concurrent hash map of region keys to @c MapChunk pointers, used to index the regions of an @c OccupancyMap .
+///
+/// The map supports lock-free lookup via @c find() and @c lookup() while inserts and removals are serialised per
+/// shard. The key space is split across @c kShardCount shards, each of which is an open addressing hash table with
+/// linear probing. Each slot stores the packed region key along side an atomic chunk pointer so lookups never need to
+/// dereference a @c MapChunk while probing. Removed items leave their key in place with a null chunk pointer
+/// (a tombstone), which is reused should the same key be inserted again.
+///
+/// Tables are never modified in a way which invalidates a concurrent reader. Growing a shard allocates a new table
+/// which is published atomically while the old table is retired. Each shard maintains a count of active readers and
+/// retired tables are only released once the shard has no active readers. Retired tables are always released by
+/// @c clear() and the destructor.
+///
+/// Note that this only makes the index itself thread safe. A @c MapChunk pointer is still invalidated when it is
+/// removed and released, so the caller must ensure chunks are not removed while other threads are using them. This
+/// matches the previous @c OccupancyMap semantics.
+///
+/// The interface mimics a subset of @c std::unordered_map to support existing code. Iteration is weakly consistent:
+/// it is safe to iterate while items are inserted or removed by other threads, but such items may or may not be
+/// visited.
+class ohm_API ChunkMap
+{
+public:
+  /// Number of shards. Must be a power of 2.
+  static constexpr unsigned kShardCount = 16u;
+  /// Initial slot capacity for each shard table. Must be a power of 2.
+  static constexpr size_t kInitialCapacity = 16u;
+  /// Maximum load factor, including tombstones, before a shard table is regrown.
+  static constexpr float kMaxLoadFactor = 0.5f;
+
+  /// Key type.
+  using key_type = glm::i16vec3;  // NOLINT(readability-identifier-naming)
+  /// Mapped value type.
+  using mapped_type = MapChunk *;  // NOLINT(readability-identifier-naming)
+  /// Iteration value type. Unlike @c std::unordered_map the key is not @c const as items are copied into the
+  /// iterator.
+  using value_type = std::pair<glm::i16vec3, MapChunk *>;  // NOLINT(readability-identifier-naming)
+
+  /// Forward iterator for @c ChunkMap . The iterator holds a copy of the current item, which remains valid even if the
+  /// item is subsequently removed from the map.
+  class ohm_API iterator  // NOLINT(readability-identifier-naming)
+  {
+  public:
+    /// Default constructor: creates an invalid iterator.
+    iterator() = default;
+    /// Copy constructor.
+    iterator(const iterator &other) = default;
+    /// Copy assignment.
+    iterator &operator=(const iterator &other) = default;
+
+    /// Equality comparison.
+    /// @param other Iterator to compare against.
+    /// @return True if both iterators reference the same slot for the same map.
+    inline bool operator==(const iterator &other) const
+    {
+      return map_ == other.map_ && shard_ == other.shard_ && slot_ == other.slot_;
+    }
+    /// Inequality comparison.
+    /// @param other Iterator to compare against.
+    /// @return True if the iterators reference different slots.
+    inline bool operator!=(const iterator &other) const { return !operator==(other); }
+
+    /// Prefix increment.
+    /// @return @c *this
+    iterator &operator++();
+    /// Postfix increment.
+    /// @return A copy of the iterator before incrementing.
+    inline iterator operator++(int)
+    {
+      iterator copy(*this);
+      ++*this;
+      return copy;
+    }
+
+    /// Dereference. Only valid for an iterator not equal to @c ChunkMap::end() .
+    /// @return The current item.
+    inline const value_type &operator*() const { return value_; }
+    /// Dereference. Only valid for an iterator not equal to @c ChunkMap::end() .
+    /// @return The current item.
+    inline const value_type *operator->() const { return &value_; }
+
+  private:
+    friend class ChunkMap;
+
+    /// Internal constructor.
+    /// @param map The map iterated.
+    /// @param shard The current shard index.
+    /// @param slot The current slot index within @p shard .
+    iterator(const ChunkMap *map, unsigned shard, unsigned slot);
+
+    /// Advance to the first valid item at or after ( @c shard_ , @c slot_ ), or to the end.
+    void seekValid();
+
+    const ChunkMap *map_ = nullptr;  ///< The map being iterated.
+    unsigned shard_ = 0;             ///< Current shard index.
+    unsigned slot_ = 0;              ///< Current slot index within @c shard_ .
+    value_type value_{};             ///< Copy of the current item.
+  };
+
+  /// Const iterator is the same as @c iterator as items are copied.
+  using const_iterator = iterator;  // NOLINT(readability-identifier-naming)
+
+  /// Constructor.
+  ChunkMap();
+  /// Destructor. Does not release the referenced @c MapChunk objects.
+  ~ChunkMap();
+
+  ChunkMap(const ChunkMap &) = delete;
+  ChunkMap &operator=(const ChunkMap &) = delete;
+
+  /// Lock-free lookup of the chunk for @p key .
+  /// @param key The region key to lookup.
+  /// @return The chunk for @p key or null if not present.
+  MapChunk *lookup(const glm::i16vec3 &key) const;
+
+  /// Lock-free search for the chunk at @p key .
+  /// @param key The region key to search for.
+  /// @return An iterator to the item or @c end() if not present.
+  iterator find(const glm::i16vec3 &key) const;
+
+  /// Insert @p chunk at @p key if not already present.
+  /// @param key The region key.
+  /// @param chunk The chunk to insert. Must not be null.
+  /// @return The chunk now present at @p key . This is @p chunk on insertion or the existing chunk when @p key was
+  ///   already present.
+  MapChunk *insert(const glm::i16vec3 &key, MapChunk *chunk);
+
+  /// Insert an item if the key is not already present. Provided for compatibility with @c std::unordered_map .
+  /// @param item The item to insert.
+  /// @return An iterator referencing the item at the key and true if the item was inserted.
+  std::pair<iterator, bool> insert(const value_type &item);
+
+  /// Remove the item at @p key .
+  /// @param key The region key to remove.
+  /// @return The removed chunk or null if @p key was not present. The caller owns the removed chunk.
+  MapChunk *remove(const glm::i16vec3 &key);
+
+  /// Remove the item at @p iter .
+  /// @param iter Iterator to the item to erase.
+  /// @return An iterator to the next item.
+  iterator erase(const iterator &iter);
+
+  /// Query the number of items in the map. This is approximate under concurrent modification.
+  /// @return The number of items.
+  size_t size() const;
+
+  /// Check if the map is empty. This is approximate under concurrent modification.
+  /// @return True if empty.
+  inline bool empty() const { return size() == 0; }
+
+  /// Clear the map and release all tables. Does not release the referenced @c MapChunk objects.
+  ///
+  /// This is not thread safe and requires exclusive access.
+  void clear();
+
+  /// Query the total number of slots across all shards. Used for memory estimates.
+  /// @return The slot count.
+  size_t bucket_count() const;  // NOLINT(readability-identifier-naming)
+
+  /// Query the maximum load factor.
+  /// @return @c kMaxLoadFactor
+  inline float max_load_factor() const { return kMaxLoadFactor; }  // NOLINT(readability-identifier-naming)
+
+  /// Iteration start.
+  /// @return An iterator to the first item.
+  iterator begin() const;
+  /// Iteration end.
+  /// @return The end iterator.
+  inline iterator end() const { return iterator(this, kShardCount, 0); }
+
+private:
+  struct Slot;
+  struct Table;
+  struct Shard;
+  class ReadGuard;
+
+  /// Pack a region key into a 64-bit slot key. The result is never zero.
+  static uint64_t packKey(const glm::i16vec3 &key);
+  /// Unpack a slot key.
+  static glm::i16vec3 unpackKey(uint64_t packed);
+  /// Hash a packed key.
+  static uint64_t hashKey(uint64_t packed);
+
+  /// Select the shard for @p hash .
+  inline Shard &shardFor(uint64_t hash) const { return *shards_[hash >> (64u - kShardBits)]; }
+
+  /// Find the slot for @p packed in @p table for a writer. Returns the matching slot or the first empty slot.
+  static Slot *findWriteSlot(Table &table, uint64_t packed, uint64_t hash);
+
+  /// Grow or rehash the table for @p shard . Must be called with the shard write lock held.
+  static void regrow(Shard &shard);
+
+  /// Release retired tables for @p shard if there are no active readers. Must be called with the shard write lock
+  /// held.
+  static void releaseRetired(Shard &shard);
+
+  /// Number of bits used to select the shard.
+  static constexpr unsigned kShardBits = 4u;
+  static_assert((1u << kShardBits) == kShardCount, "Shard bits mismatch");
+
+  std::array<std::unique_ptr<Shard>, kShardCount> shards_;  ///< Map shards.
+};
+}  // namespace ohm
+
+#endif  // OHM_CHUNKMAP_H
@@ -9,6 +9,7 @@
 #include "OhmConfig.h"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <vector>
 
@@ -22,6 +23,17 @@ struct ClearingPatternDetail
   const RayPattern *pattern = nullptr;
   unsigned ray_flags = 0u;  // Default value should be ClearingPattern::kDefaultFlags.
   bool has_pattern_ownership = false;
+
+  /// Voxel offsets from the ray origin voxel traversed by each pattern ray, concatenated. Includes the end voxel.
+  std::vector<glm::ivec3> key_template;
+  /// The end index into @c key_template for each pattern ray.
+  std::vector<size_t> key_template_ray_ends;
+  /// The rotation used to build the @c key_template .
+  glm::dquat key_template_rotation{ 1, 0, 0, 0 };
+  /// The map resolution used to build the @c key_template .
+  double key_template_resolution = 0;
+  /// Has the @c key_template been built?
+  bool key_template_valid = false;
 };
 }  // namespace ohm
 
@@ -0,0 +1,26 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_COLLISIONQUERYDETAIL_H
+#define OHM_COLLISIONQUERYDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "QueryDetail.h"
+
+#include "ohm/CollisionQuery.h"
+
+namespace ohm
+{
+/// Pimpl data for @c CollisionQuery
+struct ohm_API CollisionQueryDetail : QueryDetail
+{
+  std::vector<CollisionShape> shapes;  ///< The robot shapes.
+  std::vector<CollisionPose> poses;    ///< The poses to test, or start/end pose pairs for sweeps.
+  double padding = 0;                  ///< Padding used to inflate each shape.
+};
+}  // namespace ohm
+
+#endif  // OHM_COLLISIONQUERYDETAIL_H
@@ -0,0 +1,62 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_ESDFPROCESSDETAIL_H
+#define OHM_ESDFPROCESSDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "Key.h"
+#include "KeyList.h"
+#include "RegionChangeFeed.h"
+
+#include <glm/vec3.hpp>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+namespace ohm
+{
+/// An item in the @c EsdfProcess lower wavefront.
+struct EsdfLowerItem
+{
+  /// The voxel distance at the time the item was queued. Used to order the wavefront and to detect stale items.
+  float distance;
+  /// The voxel key.
+  Key key;
+
+  /// Ordering operator for a min heap on @c distance .
+  inline bool operator>(const EsdfLowerItem &other) const { return distance > other.distance; }
+};
+
+struct EsdfProcessDetail
+{
+  /// Voxels pending an update.
+  KeyList changed_keys;
+  /// Raise wavefront: voxels which have been invalidated and whose neighbours need checking.
+  std::deque<Key> raise_queue;
+  /// Lower wavefront: voxels with valid distances to propagate to their neighbours, nearest first.
+  std::priority_queue<EsdfLowerItem, std::vector<EsdfLowerItem>, std::greater<EsdfLowerItem>> lower_queue;
+  /// Maximum propagation distance.
+  float max_distance = 2.0f;  // NOLINT(readability-magic-numbers)
+  /// @c QueryFlag values.
+  unsigned query_flags = 0;
+  /// The map the process was last bound to. Only used to detect a map change - see @c bind() .
+  const OccupancyMap *map = nullptr;
+  /// Subscription to @c map used to receive @c OccupancyMap::rebaseOrigin() events. The queued regions are unused.
+  std::unique_ptr<RegionChangeFeed> rebase_feed;
+
+  /// Subscribe to rebase events for @p map unless already subscribed.
+  void bind(OccupancyMap &map);
+  /// Re-key the pending changes and wavefronts for an @c OccupancyMap::rebaseOrigin() , dropping keys which leave the
+  /// key range.
+  void rebase(const glm::dvec3 &region_shift);
+};
+}  // namespace ohm
+
+#endif  // OHM_ESDFPROCESSDETAIL_H
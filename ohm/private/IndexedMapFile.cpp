@@ -0,0 +1,643 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "IndexedMapFile.h"
+
+#include "OccupancyMapDetail.h"
+#include "SerialiseUtil.h"
+
+#include "ohm/MapChunk.h"
+#include "ohm/MapLayer.h"
+#include "ohm/MapSerialise.h"
+#include "ohm/Stream.h"
+#include "ohm/TaskArena.h"
+#include "ohm/VoxelBlock.h"
+#include "ohm/VoxelBuffer.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace ohm
+{
+namespace
+{
+/// Byte size of a region entry in the index table, excluding layer entries.
+const size_t kRegionEntrySize = 3 * sizeof(int32_t) + 4 * sizeof(double);
+/// Byte size of a layer entry in the index table.
+const size_t kLayerEntrySize = 3 * sizeof(uint64_t) + sizeof(uint32_t);
+/// Number of regions encoded per batch for a parallel @c IndexedMapFile::write() .
+const size_t kParallelBatchSize = 256u;
+/// A layer is written as @c IndexedMapFile::kEncodingSparse when at most one in this many voxels differ from the
+/// layer default.
+const size_t kSparseDensityDivisor = 4u;
+/// Byte size of the @c IndexedMapFile::kEncodingSparse blob header.
+const size_t kSparseHeaderSize = 2 * sizeof(uint32_t);
+
+/// Read a value from a mapped memory cursor, advancing the cursor.
+template <typename T>
+inline T readMapped(const uint8_t *&cursor)
+{
+  T value;
+  memcpy(&value, cursor, sizeof(value));
+  cursor += sizeof(value);
+  return value;
+}
+
+
+/// Append @p layer_mem to @p data using @c IndexedMapFile::kEncodingSparse if no more than one in
+/// @c kSparseDensityDivisor voxels differ from the @p layer default value.
+/// @return True if the layer was appended, false if it is too dense and @p data is unchanged.
+bool encodeSparse(const MapLayer &layer, const uint8_t *layer_mem, size_t node_byte_count,
+                  std::vector<uint8_t> &data)
+{
+  const size_t voxel_byte_size = layer.voxelByteSize();
+  if (voxel_byte_size == 0 || node_byte_count % voxel_byte_size)
+  {
+    return false;
+  }
+
+  // The default value is a cleared single voxel layer.
+  std::vector<uint8_t> fill(voxel_byte_size);
+  layer.clear(fill.data(), glm::u8vec3(1));
+
+  const size_t voxel_count = node_byte_count / voxel_byte_size;
+  const size_t max_set_count = voxel_count / kSparseDensityDivisor;
+  size_t set_count = 0;
+  for (size_t i = 0; i < voxel_count && set_count <= max_set_count; ++i)
+  {
+    set_count += memcmp(layer_mem + i * voxel_byte_size, fill.data(), voxel_byte_size) != 0;
+  }
+
+  if (set_count > max_set_count)
+  {
+    return false;
+  }
+
+  const size_t mask_size = (voxel_count + 7u) / 8u;
+  const size_t offset = data.size();
+  data.resize(offset + kSparseHeaderSize + voxel_byte_size + mask_size + set_count * voxel_byte_size, 0u);
+  uint8_t *cursor = data.data() + offset;
+  const uint32_t header[2] = { uint32_t(voxel_byte_size), uint32_t(set_count) };
+  memcpy(cursor, header, sizeof(header));
+  cursor += sizeof(header);
+  memcpy(cursor, fill.data(), voxel_byte_size);
+  cursor += voxel_byte_size;
+  uint8_t *mask = cursor;
+  uint8_t *values = mask + mask_size;
+  for (size_t i = 0; i < voxel_count; ++i)
+  {
+    const uint8_t *voxel = layer_mem + i * voxel_byte_size;
+    if (memcmp(voxel, fill.data(), voxel_byte_size) != 0)
+    {
+      mask[i / 8u] |= uint8_t(1u << (i % 8u));
+      memcpy(values, voxel, voxel_byte_size);
+      values += voxel_byte_size;
+    }
+  }
+
+  return true;
+}
+
+
+/// Decode an @c IndexedMapFile::kEncodingSparse blob written by @c encodeSparse() .
+/// @return @c kSeOk on success or a @c SerialisationError code on failure. @c kSeUnknownDataType indicates the blob
+///   voxel size does not match @p layer_voxel_byte_size .
+int decodeSparse(const uint8_t *blob, size_t stored_size, uint8_t *layer_mem, size_t node_byte_count,
+                 size_t layer_voxel_byte_size)
+{
+  if (stored_size < kSparseHeaderSize)
+  {
+    return kSeFileReadFailure;
+  }
+
+  uint32_t header[2];
+  memcpy(header, blob, sizeof(header));
+  const size_t voxel_byte_size = header[0];
+  const size_t set_count = header[1];
+  if (voxel_byte_size != layer_voxel_byte_size)
+  {
+    return kSeUnknownDataType;
+  }
+  if (voxel_byte_size == 0 || node_byte_count % voxel_byte_size)
+  {
+    return kSeFileReadFailure;
+  }
+
+  const size_t voxel_count = node_byte_count / voxel_byte_size;
+  const size_t mask_size = (voxel_count + 7u) / 8u;
+  if (set_count > voxel_count ||
+      stored_size != kSparseHeaderSize + voxel_byte_size + mask_size + set_count * voxel_byte_size)
+  {
+    return kSeFileReadFailure;
+  }
+
+  const uint8_t *fill = blob + kSparseHeaderSize;
+  const uint8_t *mask = fill + voxel_byte_size;
+  const uint8_t *values = mask + mask_size;
+  const uint8_t *values_end = values + set_count * voxel_byte_size;
+  for (size_t i = 0; i < voxel_count; ++i)
+  {
+    uint8_t *voxel = layer_mem + i * voxel_byte_size;
+    if (mask[i / 8u] & (1u << (i % 8u)))
+    {
+      if (values == values_end)
+      {
+        return kSeFileReadFailure;
+      }
+      memcpy(voxel, values, voxel_byte_size);
+      values += voxel_byte_size;
+    }
+    else
+    {
+      memcpy(voxel, fill, voxel_byte_size);
+    }
+  }
+
+  return (values == values_end) ? kSeOk : kSeFileReadFailure;
+}
+}  // namespace
+
+
+IndexedMapFile::IndexedMapFile() = default;
+
+
+IndexedMapFile::~IndexedMapFile() = default;
+
+
+int IndexedMapFile::write(OutputStream &stream, const OccupancyMapDetail &detail, size_t index_offset_pos,
+                          unsigned flags, SerialiseProgress *progress)
+{
+  std::vector<unsigned> serialised_layers;
+  serialisedLayers(detail.layout, serialised_layers);
+
+  std::vector<const MapChunk *> chunks;
+  chunks.reserve(detail.chunks.size());
+  for (const auto &chunk_ref : detail.chunks)
+  {
+    chunks.emplace_back(chunk_ref.second);
+  }
+
+  std::vector<RegionEntry> regions;
+  std::vector<LayerEntry> layers;
+  regions.reserve(chunks.size());
+  layers.reserve(chunks.size() * serialised_layers.size());
+
+  const bool compress = (flags & kImfCompress) != 0;
+  const bool sparse = (flags & kImfSparse) != 0;
+  // Regions are encoded in batches, in parallel if requested, then written in order. The batch size bounds the
+  // memory used to hold encoded regions.
+  const size_t batch_size = (flags & kImfParallel) ? kParallelBatchSize : 1u;
+  std::vector<EncodedRegion> encoded(std::min(batch_size, chunks.size()));
+  const auto encode_region = [&](size_t batch_start, size_t i) {
+    encodeRegion(*chunks[batch_start + i], detail, serialised_layers, compress, encoded[i], sparse);
+  };
+
+  bool ok = true;
+  for (size_t batch_start = 0; ok && batch_start < chunks.size() && (!progress || !progress->quit());
+       batch_start += batch_size)
+  {
+    const size_t batch_count = std::min(batch_size, chunks.size() - batch_start);
+#ifdef OHM_FEATURE_THREADS
+    if (batch_count > 1)
+    {
+      parallelExecute([&]() {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0u, batch_count), [&](const tbb::blocked_range<size_t> &range) {
+          for (size_t i = range.begin(); i < range.end(); ++i)
+          {
+            encode_region(batch_start, i);
+          }
+        });
+      });
+    }
+    else
+#endif  // OHM_FEATURE_THREADS
+    {
+      for (size_t i = 0; i < batch_count; ++i)
+      {
+        encode_region(batch_start, i);
+      }
+    }
+
+    for (size_t i = 0; ok && i < batch_count; ++i)
+    {
+      const MapChunk &chunk = *chunks[batch_start + i];
+      EncodedRegion &region_data = encoded[i];
+      if (region_data.error)
+      {
+        return region_data.error;
+      }
+
+      RegionEntry region_entry;
+      region_entry.coord = chunk.region.coord;
+      region_entry.centre = chunk.region.centre;
+      region_entry.touched_time = chunk.touched_time;
+      region_entry.layer_begin = layers.size();
+      regions.emplace_back(region_entry);
+
+      // Layer offsets are relative to the region blob start.
+      const uint64_t region_offset = stream.tell();
+      for (LayerEntry layer_entry : region_data.layers)
+      {
+        layer_entry.offset += region_offset;
+        layers.emplace_back(layer_entry);
+      }
+
+      ok = stream.writeUncompressed(region_data.data.data(), unsigned(region_data.data.size())) ==
+             region_data.data.size() &&
+           ok;
+
+      if (progress)
+      {
+        progress->incrementProgress();
+      }
+    }
+  }
+
+  if (!ok)
+  {
+    return kSeFileWriteFailure;
+  }
+
+  // Write the index table.
+  const uint64_t index_offset = stream.tell();
+  ok = writeUncompressed<uint32_t>(stream, regions.size()) && ok;
+  ok = writeUncompressed<uint32_t>(stream, serialised_layers.size()) && ok;
+  for (const RegionEntry &region_entry : regions)
+  {
+    ok = writeUncompressed<int32_t>(stream, region_entry.coord.x) && ok;
+    ok = writeUncompressed<int32_t>(stream, region_entry.coord.y) && ok;
+    ok = writeUncompressed<int32_t>(stream, region_entry.coord.z) && ok;
+    ok = writeUncompressed<double>(stream, region_entry.centre.x) && ok;
+    ok = writeUncompressed<double>(stream, region_entry.centre.y) && ok;
+    ok = writeUncompressed<double>(stream, region_entry.centre.z) && ok;
+    ok = writeUncompressed<double>(stream, region_entry.touched_time) && ok;
+    for (size_t i = 0; i < serialised_layers.size(); ++i)
+    {
+      const LayerEntry &layer_entry = layers[region_entry.layer_begin + i];
+      ok = writeUncompressed<uint64_t>(stream, layer_entry.touched_stamp) && ok;
+      ok = writeUncompressed<uint64_t>(stream, layer_entry.offset) && ok;
+      ok = writeUncompressed<uint64_t>(stream, layer_entry.stored_size) && ok;
+      ok = writeUncompressed<uint32_t>(stream, layer_entry.encoding) && ok;
+    }
+  }
+
+  // Update the index offset.
+  stream.seek(index_offset_pos);
+  ok = writeUncompressed<uint64_t>(stream, index_offset) && ok;
+
+  return (ok) ? kSeOk : kSeFileWriteFailure;
+}
+
+
+void IndexedMapFile::serialisedLayers(const MapLayout &layout, std::vector<unsigned> &serialised_layers)
+{
+  for (unsigned i = 0; i < unsigned(layout.layerCount()); ++i)
+  {
+    // Group members are serialised with the group layer.
+    if (!(layout.layer(i).flags() & (MapLayer::kSkipSerialise | MapLayer::kGroupMember)))
+    {
+      serialised_layers.emplace_back(i);
+    }
+  }
+}
+
+
+void IndexedMapFile::selectLayers(const MapLayout &layout, const CopyLayerFilter &layer_filter,
+                                  std::vector<bool> &load_layers)
+{
+  load_layers.clear();
+  if (!layer_filter)
+  {
+    return;
+  }
+
+  load_layers.resize(layout.layerCount(), false);
+  for (unsigned i = 0; i < unsigned(layout.layerCount()); ++i)
+  {
+    const MapLayer &layer = layout.layer(i);
+    if (layer_filter(layer.name()))
+    {
+      load_layers[i] = true;
+      if (layer.isGroupMember())
+      {
+        load_layers[layer.groupLayer()] = true;
+      }
+    }
+  }
+}
+
+
+void IndexedMapFile::encodeRegion(const MapChunk &chunk, const OccupancyMapDetail &detail,
+                                  const std::vector<unsigned> &serialised_layers, bool compress,
+                                  EncodedRegion &encoded, bool sparse)
+{
+  const MapLayout &layout = detail.layout;
+  encoded.data.clear();
+  encoded.layers.clear();
+  encoded.error = kSeOk;
+
+  std::vector<uint8_t> compressed_bytes;
+  for (unsigned layer_index : serialised_layers)
+  {
+    const MapLayer &layer = layout.layer(layer_index);
+    const size_t node_byte_count = layer.layerByteSize(detail.region_voxel_dimensions);
+    if (node_byte_count != unsigned(node_byte_count))
+    {
+      encoded.error = kSeValueOverflow;
+      return;
+    }
+
+    LayerEntry layer_entry;
+    layer_entry.touched_stamp = chunk.layerTouchedStamp(layer_index);
+    layer_entry.offset = encoded.data.size();
+    layer_entry.encoding = kEncodingRaw;
+    layer_entry.stored_size = node_byte_count;
+
+    // Pass deflate compressed blocks straight through: they are zlib streams, decodable as kEncodingZLib. Fetch
+    // before the sparse check, which uncompresses the block.
+    VoxelBlock::CompressionType compression_type = VoxelBlock::kCompressDeflate;
+    const bool pass_through = compress &&
+                              chunk.voxel_blocks[layer_index]->compressedBytes(compressed_bytes, &compression_type) &&
+                              compression_type == VoxelBlock::kCompressDeflate;
+
+    if (sparse)
+    {
+      VoxelBuffer<const VoxelBlock> voxel_buffer(chunk.voxel_blocks[layer_index]);
+      if (encodeSparse(layer, voxel_buffer.voxelMemory(), node_byte_count, encoded.data))
+      {
+        layer_entry.stored_size = encoded.data.size() - layer_entry.offset;
+        layer_entry.encoding = kEncodingSparse;
+        encoded.layers.emplace_back(layer_entry);
+        continue;
+      }
+    }
+
+    if (pass_through)
+    {
+      layer_entry.stored_size = compressed_bytes.size();
+      layer_entry.encoding = kEncodingZLib;
+      encoded.data.insert(encoded.data.end(), compressed_bytes.begin(), compressed_bytes.end());
+      encoded.layers.emplace_back(layer_entry);
+      continue;
+    }
+
+    VoxelBuffer<const VoxelBlock> voxel_buffer(chunk.voxel_blocks[layer_index]);
+    const uint8_t *layer_mem = voxel_buffer.voxelMemory();
+
+    if (compress)
+    {
+      uLongf compressed_size = compressBound(uLong(node_byte_count));
+      encoded.data.resize(layer_entry.offset + compressed_size);
+      if (compress2(encoded.data.data() + layer_entry.offset, &compressed_size, layer_mem, uLong(node_byte_count),
+                    Z_BEST_SPEED) == Z_OK &&
+          compressed_size < node_byte_count)
+      {
+        layer_entry.stored_size = compressed_size;
+        layer_entry.encoding = kEncodingZLib;
+      }
+    }
+
+    encoded.data.resize(layer_entry.offset + layer_entry.stored_size);
+    if (layer_entry.encoding == kEncodingRaw)
+    {
+      memcpy(encoded.data.data() + layer_entry.offset, layer_mem, node_byte_count);
+    }
+    encoded.layers.emplace_back(layer_entry);
+  }
+}
+
+
+int IndexedMapFile::decodeLayer(const LayerEntry &layer_entry, const uint8_t *blob, uint8_t *layer_mem,
+                                size_t node_byte_count, size_t voxel_byte_size)
+{
+  switch (layer_entry.encoding)
+  {
+  case kEncodingRaw:
+    if (layer_entry.stored_size != node_byte_count)
+    {
+      return kSeFileReadFailure;
+    }
+    memcpy(layer_mem, blob, node_byte_count);
+    break;
+  case kEncodingZLib: {
+    uLongf decompressed_size = uLongf(node_byte_count);
+    if (uncompress(layer_mem, &decompressed_size, blob, uLong(layer_entry.stored_size)) != Z_OK ||
+        decompressed_size != node_byte_count)
+    {
+      return kSeFileReadFailure;
+    }
+    break;
+  }
+  case kEncodingSparse:
+    return decodeSparse(blob, layer_entry.stored_size, layer_mem, node_byte_count, voxel_byte_size);
+  default:
+    return kSeUnknownDataType;
+  }
+
+  return kSeOk;
+}
+
+
+int IndexedMapFile::open(const std::string &filename, uint64_t index_offset, const OccupancyMapDetail &detail)
+{
+  regions_.clear();
+  layers_.clear();
+  serialised_layers_.clear();
+  eager_layers_.clear();
+  lookup_.clear();
+  states_.reset();
+
+  if (!file_.open(filename))
+  {
+    return kSeFileOpenFailure;
+  }
+
+  serialisedLayers(detail.layout, serialised_layers_);
+
+  if (index_offset + 2 * sizeof(uint32_t) > file_.size())
+  {
+    return kSeFileReadFailure;
+  }
+
+  const uint8_t *cursor = file_.data() + index_offset;
+  const auto region_count = readMapped<uint32_t>(cursor);
+  const auto layer_count = readMapped<uint32_t>(cursor);
+
+  if (layer_count != serialised_layers_.size())
+  {
+    return kSeFileReadFailure;
+  }
+
+  const size_t index_size = size_t(region_count) * (kRegionEntrySize + layer_count * kLayerEntrySize);
+  if (index_offset + 2 * sizeof(uint32_t) + index_size > file_.size())
+  {
+    return kSeFileReadFailure;
+  }
+
+  regions_.resize(region_count);
+  layers_.resize(size_t(region_count) * layer_count);
+  lookup_.reserve(region_count);
+  for (uint32_t i = 0; i < region_count; ++i)
+  {
+    RegionEntry &region_entry = regions_[i];
+    region_entry.coord.x = int16_t(readMapped<int32_t>(cursor));
+    region_entry.coord.y = int16_t(readMapped<int32_t>(cursor));
+    region_entry.coord.z = int16_t(readMapped<int32_t>(cursor));
+    region_entry.centre.x = readMapped<double>(cursor);
+    region_entry.centre.y = readMapped<double>(cursor);
+    region_entry.centre.z = readMapped<double>(cursor);
+    region_entry.touched_time = readMapped<double>(cursor);
+    region_entry.layer_begin = size_t(i) * layer_count;
+
+    for (uint32_t j = 0; j < layer_count; ++j)
+    {
+      LayerEntry &layer_entry = layers_[region_entry.layer_begin + j];
+      layer_entry.touched_stamp = readMapped<uint64_t>(cursor);
+      layer_entry.offset = readMapped<uint64_t>(cursor);
+      layer_entry.stored_size = readMapped<uint64_t>(cursor);
+      layer_entry.encoding = readMapped<uint32_t>(cursor);
+
+      if (layer_entry.offset + layer_entry.stored_size > file_.size())
+      {
+        return kSeFileReadFailure;
+      }
+    }
+
+    lookup_.emplace(region_entry.coord, i);
+  }
+
+  states_ = std::make_unique<std::atomic_uint8_t[]>(region_count);
+  for (uint32_t i = 0; i < region_count; ++i)
+  {
+    states_[i] = kLsUnloaded;
+  }
+
+  return kSeOk;
+}
+
+
+int IndexedMapFile::findRegion(const glm::i16vec3 &coord) const
+{
+  const auto search = lookup_.find(coord);
+  return (search != lookup_.end()) ? int(search->second) : -1;
+}
+
+
+int IndexedMapFile::loadRegion(size_t region_index, MapChunk &chunk, const OccupancyMapDetail &detail,
+                               const std::vector<bool> *load_layers, bool defer_unselected) const
+{
+  const bool select_layers = load_layers && !load_layers->empty();
+  const RegionEntry &region_entry = regions_[region_index];
+  chunk.region.coord = region_entry.coord;
+  chunk.region.centre = region_entry.centre;
+  chunk.touched_time = region_entry.touched_time;
+
+  const MapLayout &layout = detail.layout;
+  size_t serialised_index = 0;
+  for (unsigned i = 0; i < unsigned(layout.layerCount()); ++i)
+  {
+    const MapLayer &layer = layout.layer(i);
+    if (layer.isGroupMember())
+    {
+      // Loaded with the group layer.
+      continue;
+    }
+
+    if (serialised_index >= serialised_layers_.size() || serialised_layers_[serialised_index] != i)
+    {
+      // Not serialised. Clear instead.
+      VoxelBuffer<VoxelBlock> voxel_buffer(chunk.voxel_blocks[i]);
+      layer.clear(voxel_buffer.voxelMemory(), detail.region_voxel_dimensions);
+      continue;
+    }
+
+    const LayerEntry &layer_entry = layers_[region_entry.layer_begin + serialised_index++];
+    const bool selected = !select_layers || (i < load_layers->size() && (*load_layers)[i]);
+    if (!selected && !defer_unselected)
+    {
+      // Not selected. Skip decoding the blob.
+      VoxelBuffer<VoxelBlock> voxel_buffer(chunk.voxel_blocks[i]);
+      layer.clear(voxel_buffer.voxelMemory(), detail.region_voxel_dimensions);
+      continue;
+    }
+
+    chunk.touched_stamps[i] = layer_entry.touched_stamp;
+
+    const size_t node_byte_count = layer.layerByteSize(detail.region_voxel_dimensions);
+    const size_t voxel_byte_size = layer.voxelByteSize();
+    const uint8_t *blob = file_.data() + layer_entry.offset;
+    if (!selected)
+    {
+      // Decode on first access. The loader shares ownership of this file to keep the blob mapped.
+      std::shared_ptr<const IndexedMapFile> file = shared_from_this();
+      const LayerEntry deferred_entry = layer_entry;
+      chunk.voxel_blocks[i]->setDeferredLoader(
+        [file, deferred_entry, blob, node_byte_count, voxel_byte_size](uint8_t *voxel_memory, size_t byte_size) {
+          return byte_size == node_byte_count &&
+                 decodeLayer(deferred_entry, blob, voxel_memory, byte_size, voxel_byte_size) == kSeOk;
+        });
+      continue;
+    }
+
+    VoxelBuffer<VoxelBlock> voxel_buffer(chunk.voxel_blocks[i]);
+    const int err = decodeLayer(layer_entry, blob, voxel_buffer.voxelMemory(), node_byte_count, voxel_byte_size);
+    if (err)
+    {
+      return err;
+    }
+  }
+
+  return kSeOk;
+}
+
+
+void IndexedMapFile::updateFirstValid(MapChunk &chunk, const OccupancyMapDetail &detail)
+{
+  const int occupancy_layer = detail.layout.occupancyLayer();
+  if (occupancy_layer >= 0)
+  {
+    const VoxelBlock *block = chunk.voxel_blocks[occupancy_layer].get();
+    block = (block->groupBlock()) ? block->groupBlock() : block;
+    if (block->flags() & VoxelBlock::kFDeferred)
+    {
+      // Searching would load the occupancy layer. Search the whole region instead.
+      chunk.first_valid_index = 0;
+      return;
+    }
+  }
+
+  chunk.searchAndUpdateFirstValid(detail.region_voxel_dimensions);
+}
+
+
+bool IndexedMapFile::claim(size_t region_index)
+{
+  uint8_t expected = kLsUnloaded;
+  return states_[region_index].compare_exchange_strong(expected, kLsLoading);
+}
+
+
+void IndexedMapFile::markLoaded(size_t region_index)
+{
+  states_[region_index] = kLsLoaded;
+}
+
+
+void IndexedMapFile::waitLoaded(size_t region_index) const
+{
+  while (states_[region_index] != kLsLoaded)
+  {
+    std::this_thread::yield();
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,256 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_INDEXEDMAPFILE_H
+#define OHM_INDEXEDMAPFILE_H
+
+#include "OhmConfig.h"
+
+#include "MemoryMappedFile.h"
+
+#include "ohm/CopyUtil.h"
+#include "ohm/MapRegion.h"
+
+#include <glm/vec3.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+class MapLayout;
+class OutputStream;
+class SerialiseProgress;
+struct MapChunk;
+struct OccupancyMapDetail;
+
+/// Random access region data for the indexed map format (version 0.6) - see @c ohm::saveIndexed() .
+///
+/// The file format is as follows:
+/// - The map header, matching previous versions, with the region count and version 0.6.0.
+/// - A @c uint64_t file offset to the region index table.
+/// - The @c MapInfo and @c MapLayout matching previous versions, but always uncompressed.
+/// - Layer blobs for each region. Each blob holds the voxel data for one serialised layer of one region. Blobs are
+///   either raw or independently zlib compressed.
+/// - The region index table:
+///   - @c uint32_t region count
+///   - @c uint32_t serialised layer count: the number of layers without @c MapLayer::kSkipSerialise
+///   - For each region:
+///     - @c int32_t region coordinates x, y, z
+///     - @c double region centre x, y, z
+///     - @c double touched time
+///     - For each serialised layer:
+///       - @c uint64_t layer touched stamp
+///       - @c uint64_t blob file offset
+///       - @c uint64_t blob stored size (bytes)
+///       - @c uint32_t blob @c Encoding
+///
+/// The file content is memory mapped, allowing regions to be loaded on demand and in any order. A region may be
+/// loaded at most once via the @c claim() and @c markLoaded() protocol which supports concurrent page in requests.
+///
+/// Layers may also be loaded lazily: @c loadRegion() can defer decoding a layer blob until the layer's @c VoxelBlock
+/// is first retained. Deferred blocks share ownership of the file, so the file must be owned by a @c std::shared_ptr
+/// to defer layers.
+class IndexedMapFile : public std::enable_shared_from_this<IndexedMapFile>
+{
+public:
+  /// Layer blob encoding.
+  enum Encoding : uint32_t
+  {
+    /// Raw voxel data.
+    kEncodingRaw = 0u,
+    /// Zlib compressed voxel data.
+    kEncodingZLib = 1u,
+    /// Sparse voxel data: voxels which differ from a fill value. The blob holds:
+    /// - @c uint32_t voxel byte size
+    /// - @c uint32_t count of voxels which differ from the fill value
+    /// - The fill voxel value; the layer default.
+    /// - A bit mask with a set bit for each voxel which differs from the fill value, padded to whole bytes.
+    /// - The values of the voxels with set bits, in voxel order.
+    kEncodingSparse = 2u
+  };
+
+  /// Index table details for a layer of a region.
+  struct LayerEntry
+  {
+    uint64_t touched_stamp = 0;  ///< @c MapChunk::touched_stamps for the layer.
+    uint64_t offset = 0;         ///< Blob file offset.
+    uint64_t stored_size = 0;    ///< Blob byte size as stored.
+    uint32_t encoding = 0;       ///< Blob @c Encoding .
+  };
+
+  /// Index table details for a region.
+  struct RegionEntry
+  {
+    glm::i16vec3 coord{ 0 };       ///< Region key.
+    glm::dvec3 centre{ 0 };        ///< Region centre.
+    double touched_time = 0;       ///< @c MapChunk::touched_time
+    size_t layer_begin = 0;        ///< Index of the first @c LayerEntry for this region.
+  };
+
+  /// Region load state for the @c claim() protocol.
+  enum LoadState : uint8_t
+  {
+    kLsUnloaded = 0u,
+    kLsLoading,
+    kLsLoaded
+  };
+
+  /// Encoded layer blobs for a region, ready to write.
+  struct EncodedRegion
+  {
+    std::vector<uint8_t> data;       ///< Concatenated layer blobs.
+    std::vector<LayerEntry> layers;  ///< Layer entries with offsets relative to the start of @c data .
+    int error = 0;                   ///< @c SerialisationError from encoding.
+  };
+
+  /// Constructor.
+  IndexedMapFile();
+  /// Destructor.
+  ~IndexedMapFile();
+
+  /// Write the region data blobs and index table for @p detail to @p stream , then update the index table offset
+  /// at @p index_offset_pos .
+  /// @param stream The stream to write to. Must be open without @c kSfCompress .
+  /// @param detail The map to write.
+  /// @param index_offset_pos Stream position at which to write the index table offset.
+  /// @param flags @c IndexedMapFlag values. With @c kImfParallel regions are encoded in parallel batches, but
+  ///   always written in order.
+  /// @param progress Optional progress reporting. Progress is incremented for each region from the calling thread.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  static int write(OutputStream &stream, const OccupancyMapDetail &detail, size_t index_offset_pos, unsigned flags,
+                   SerialiseProgress *progress);
+
+  /// Collect the @c MapLayout indices of the layers to serialise; those without @c MapLayer::kSkipSerialise .
+  /// @param layout The map layout.
+  /// @param[out] serialised_layers Populated with the serialised layer indices.
+  static void serialisedLayers(const MapLayout &layout, std::vector<unsigned> &serialised_layers);
+
+  /// Resolve the layers selected by @p layer_filter for @c loadRegion() . Selecting a group member selects its group
+  /// layer.
+  /// @param layout The map layout.
+  /// @param layer_filter The layer filter. All layers are selected when empty.
+  /// @param[out] load_layers Set to the selection per @c MapLayout layer index, or cleared when all layers are
+  ///   selected.
+  static void selectLayers(const MapLayout &layout, const CopyLayerFilter &layer_filter,
+                           std::vector<bool> &load_layers);
+
+  /// Encode the serialised layers of @p chunk . This is thread safe.
+  ///
+  /// When compressing, blocks already compressed with @c VoxelBlock::kCompressDeflate are written as stored without
+  /// uncompressing them, unless written as @c kEncodingSparse .
+  /// @param chunk The chunk to encode.
+  /// @param detail The owning map detail.
+  /// @param serialised_layers @c MapLayout indices of the layers to encode.
+  /// @param compress Compress the layer blobs?
+  /// @param[out] encoded The encoded region.
+  /// @param sparse Use @c kEncodingSparse for layers with few voxels differing from the layer default.
+  static void encodeRegion(const MapChunk &chunk, const OccupancyMapDetail &detail,
+                           const std::vector<unsigned> &serialised_layers, bool compress, EncodedRegion &encoded,
+                           bool sparse = false);
+
+  /// Decode a layer blob written by @c encodeRegion() .
+  /// @param layer_entry The layer entry describing the blob.
+  /// @param blob Pointer to the blob data of @c LayerEntry::stored_size bytes.
+  /// @param[out] layer_mem Voxel memory to decode into.
+  /// @param node_byte_count The byte size of @p layer_mem .
+  /// @param voxel_byte_size The @c MapLayer::voxelByteSize() of the layer being decoded.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  static int decodeLayer(const LayerEntry &layer_entry, const uint8_t *blob, uint8_t *layer_mem,
+                         size_t node_byte_count, size_t voxel_byte_size);
+
+  /// Memory map @p filename and read the index table from @p index_offset . The @p detail must have a valid
+  /// @c MapLayout loaded.
+  /// @param filename The file to open.
+  /// @param index_offset The region index table offset.
+  /// @param detail The map into which regions will be loaded.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  int open(const std::string &filename, uint64_t index_offset, const OccupancyMapDetail &detail);
+
+  /// Query the number of regions in the file.
+  /// @return The region count.
+  inline size_t regionCount() const { return regions_.size(); }
+
+  /// Access a region entry.
+  /// @param region_index The region index [0, @c regionCount() ).
+  /// @return The region entry.
+  inline const RegionEntry &region(size_t region_index) const { return regions_[region_index]; }
+
+  /// Access the layer entry of a region.
+  /// @param region_index The region index [0, @c regionCount() ).
+  /// @param layer The index of the layer in @c storedLayers() .
+  /// @return The layer entry.
+  inline const LayerEntry &layer(size_t region_index, size_t layer) const
+  {
+    return layers_[regions_[region_index].layer_begin + layer];
+  }
+
+  /// Query the @c MapLayout indices of the layers stored in the file.
+  /// @return The serialised layer indices.
+  inline const std::vector<unsigned> &storedLayers() const { return serialised_layers_; }
+
+  /// Find the index of the region at @p coord .
+  /// @param coord The region key.
+  /// @return The region index or -1 if not present.
+  int findRegion(const glm::i16vec3 &coord) const;
+
+  /// Load the voxel data for a region into @p chunk . The over all @c claim() protocol is the responsibility of the
+  /// caller. This function is thread safe.
+  /// @param region_index The region index [0, @c regionCount() ).
+  /// @param chunk The chunk to load into.
+  /// @param detail The target map detail.
+  /// @param load_layers Optional selection of the layers to load, indexed by @c MapLayout layer index. Unselected
+  ///   layers are cleared without decoding their blobs. Group members load with their group layer, so only the
+  ///   group layer entry is considered. All layers are loaded when null or empty.
+  /// @param defer_unselected Defer loading the unselected layers instead of clearing them. Their blobs are decoded
+  ///   on first access to the layer - see @c VoxelBlock::setDeferredLoader() . Requires shared ownership of the file.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  int loadRegion(size_t region_index, MapChunk &chunk, const OccupancyMapDetail &detail,
+                 const std::vector<bool> *load_layers = nullptr, bool defer_unselected = false) const;
+
+  /// Update the @c MapChunk::first_valid_index of a chunk after @c loadRegion() . This avoids loading a deferred
+  /// occupancy layer, in which case the whole region is marked for searching.
+  /// @param chunk The loaded chunk.
+  /// @param detail The target map detail.
+  static void updateFirstValid(MapChunk &chunk, const OccupancyMapDetail &detail);
+
+  /// Set the layers loaded eagerly when regions are paged in via @c OccupancyMap::region() . Other serialised layers
+  /// are deferred. See @c loadRegion() .
+  /// @param eager_layers Selection per @c MapLayout layer index. Empty to load all layers eagerly.
+  inline void setEagerLayers(const std::vector<bool> &eager_layers) { eager_layers_ = eager_layers; }
+
+  /// Query the layers loaded eagerly on page in. See @c setEagerLayers() .
+  /// @return The eager layer selection. Empty when all layers are loaded eagerly.
+  inline const std::vector<bool> &eagerLayers() const { return eager_layers_; }
+
+  /// Attempt to claim the right to load a region. Only one caller is able to successfully claim a region, after which
+  /// @c markLoaded() must be called.
+  /// @param region_index The region index [0, @c regionCount() ).
+  /// @return True if the region is now claimed by the caller, false if already claimed.
+  bool claim(size_t region_index);
+
+  /// Mark a region claimed via @c claim() as loaded.
+  /// @param region_index The region index [0, @c regionCount() ).
+  void markLoaded(size_t region_index);
+
+  /// Block until the region completes loading after a failed @c claim() .
+  /// @param region_index The region index [0, @c regionCount() ).
+  void waitLoaded(size_t region_index) const;
+
+private:
+  MemoryMappedFile file_;                ///< The mapped file.
+  std::vector<RegionEntry> regions_;     ///< Region index table.
+  std::vector<LayerEntry> layers_;       ///< Layer index table. @c serialised_layers_ items per region.
+  std::vector<unsigned> serialised_layers_;  ///< @c MapLayout indices for the serialised layers.
+  std::vector<bool> eager_layers_;           ///< Layers loaded eagerly on page in. Empty for all.
+  std::unique_ptr<std::atomic_uint8_t[]> states_;  ///< @c LoadState for each region.
+  std::unordered_map<glm::i16vec3, unsigned, MapRegion::Hash> lookup_;  ///< Region key to index lookup.
+};
+}  // namespace ohm
+
+#endif  // OHM_INDEXEDMAPFILE_H
@@ -15,6 +15,7 @@
 namespace ohm
 {
 class ClearanceProcess;
+class VoxelRangeCache;
 
 struct ohm_API LineQueryDetail : QueryDetail
 {
@@ -29,6 +30,8 @@ struct ohm_API LineQueryDetail : QueryDetail
   /// Range reported for unobstructed voxels.
   float default_range = -1;
   float search_radius = 0;
+  /// Optional, external range cache. See @c LineQuery::setRangeCache() .
+  VoxelRangeCache *range_cache = nullptr;
 };
 }  // namespace ohm
 
@@ -0,0 +1,34 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPDELTADETAIL_H
+#define OHM_MAPDELTADETAIL_H
+
+#include "OhmConfig.h"
+
+#include "RegionScheduler.h"
+
+#include <vector>
+
+namespace ohm
+{
+struct MapDeltaEncoderDetail
+{
+  /// Changed regions awaiting encoding.
+  RegionScheduler pending;
+  /// Message buffer, retained to avoid reallocation.
+  std::vector<uint8_t> message;
+  /// Region record buffer.
+  std::vector<uint8_t> record;
+  /// Source map stamp at which changed regions were last collected.
+  uint64_t last_stamp = 0;
+  /// Source map stamp of the last message sent. Recorded as the message from stamp.
+  uint64_t sent_stamp = 0;
+  /// Target maximum message size. Zero for no limit.
+  size_t byte_budget = 0;
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPDELTADETAIL_H
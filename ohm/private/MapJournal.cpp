@@ -0,0 +1,510 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapJournal.h"
+
+#include "IndexedMapFile.h"
+#include "MemoryMappedFile.h"
+#include "OccupancyMapDetail.h"
+
+#include "ohm/MapChunk.h"
+#include "ohm/MapLayer.h"
+#include "ohm/MapSerialise.h"
+#include "ohm/OccupancyMap.h"
+#include "ohm/Stream.h"
+#include "ohm/VoxelBlock.h"
+#include "ohm/VoxelBuffer.h"
+#include "ohm/VoxelOrder.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace ohm
+{
+namespace
+{
+/// Marker bytes identifying a map journal.
+const uint32_t kMapJournalMarker = 0x44330022u;
+/// Marker bytes starting each journal record.
+const uint32_t kRecordMarker = 0x4a524543u;
+/// Current journal format version.
+const MapVersion kJournalVersion = { 0, 2, 0 };
+/// Byte size of the marker and version at the start of the journal header.
+const size_t kJournalVersionSize = 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+/// A committed region record located in the mapped journal.
+struct JournalRegion
+{
+  const uint8_t *payload = nullptr;  ///< Record payload.
+  size_t size = 0;                   ///< Payload byte size.
+};
+
+/// Results from @c scanRecords() .
+struct JournalScan
+{
+  std::vector<JournalRegion> regions;  ///< Region records from all committed deltas, in journal order.
+  const uint8_t *valid_end = nullptr;  ///< End of the last committed delta.
+  uint64_t stamp = 0;                  ///< Map stamp of the last committed delta.
+  double first_ray_time = -1.0;        ///< First ray time of the last committed delta.
+  unsigned delta_count = 0;            ///< Number of committed deltas.
+};
+
+/// Append a typed value to @p buffer .
+template <typename T, typename S>
+inline void appendValue(std::vector<uint8_t> &buffer, const S &val)
+{
+  const T val2 = static_cast<T>(val);
+  const size_t offset = buffer.size();
+  buffer.resize(offset + sizeof(val2));
+  memcpy(buffer.data() + offset, &val2, sizeof(val2));
+}
+
+/// Read a typed value from @p cursor , advancing the cursor. Fails if fewer than @c sizeof(T) bytes remain.
+template <typename T, typename S>
+inline bool readValue(const uint8_t *&cursor, const uint8_t *end, S &val)
+{
+  if (size_t(end - cursor) < sizeof(T))
+  {
+    return false;
+  }
+  T val2;
+  memcpy(&val2, cursor, sizeof(val2));
+  cursor += sizeof(val2);
+  val = static_cast<S>(val2);
+  return true;
+}
+
+inline uint32_t payloadCrc(const uint8_t *payload, size_t size)
+{
+  return uint32_t(crc32(crc32(0L, Z_NULL, 0), payload, uInt(size)));
+}
+
+/// Append a record of @p type with @p payload to @p buffer .
+void appendRecord(std::vector<uint8_t> &buffer, MapJournal::RecordType type, const uint8_t *payload, size_t size)
+{
+  appendValue<uint32_t>(buffer, kRecordMarker);
+  appendValue<uint32_t>(buffer, type);
+  appendValue<uint64_t>(buffer, size);
+  appendValue<uint32_t>(buffer, payloadCrc(payload, size));
+  buffer.insert(buffer.end(), payload, payload + size);
+}
+
+bool writeRecord(OutputStream &stream, const std::vector<uint8_t> &record)
+{
+  return stream.writeUncompressed(record.data(), unsigned(record.size())) == record.size();
+}
+
+int checkHeader(const uint8_t *data, size_t size, const std::vector<uint8_t> &header)
+{
+  if (size < kJournalVersionSize || memcmp(data, header.data(), sizeof(kMapJournalMarker)) != 0)
+  {
+    return kSeFileReadFailure;
+  }
+
+  if (memcmp(data, header.data(), kJournalVersionSize) != 0)
+  {
+    return kSeUnsupportedVersion;
+  }
+
+  if (size < header.size() || memcmp(data, header.data(), header.size()) != 0)
+  {
+    return kSeJournalMismatch;
+  }
+
+  return kSeOk;
+}
+
+/// Scan the records in [@p begin, @p end) collecting committed regions. Scanning stops at the first incomplete or
+/// corrupt record.
+void scanRecords(const uint8_t *begin, const uint8_t *end, JournalScan &scan)
+{
+  std::vector<JournalRegion> pending;
+  const uint8_t *cursor = begin;
+  scan.valid_end = begin;
+
+  while (cursor < end)
+  {
+    uint32_t marker = 0;
+    uint32_t type = 0;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    if (!readValue<uint32_t>(cursor, end, marker) || marker != kRecordMarker ||
+        !readValue<uint32_t>(cursor, end, type) || !readValue<uint64_t>(cursor, end, size) ||
+        !readValue<uint32_t>(cursor, end, crc))
+    {
+      break;
+    }
+
+    if (size > uint64_t(end - cursor) || size != uInt(size))
+    {
+      break;
+    }
+
+    JournalRegion record;
+    record.payload = cursor;
+    record.size = size_t(size);
+    cursor += size;
+
+    if (payloadCrc(record.payload, record.size) != crc)
+    {
+      break;
+    }
+
+    if (type == MapJournal::kRecordRegion)
+    {
+      pending.emplace_back(record);
+    }
+    else if (type == MapJournal::kRecordCommit)
+    {
+      const uint8_t *commit_cursor = record.payload;
+      const uint8_t *commit_end = record.payload + record.size;
+      uint64_t from_stamp = 0;
+      uint64_t stamp = 0;
+      uint32_t region_count = 0;
+      double first_ray_time = -1.0;
+      if (!readValue<uint64_t>(commit_cursor, commit_end, from_stamp) ||
+          !readValue<uint64_t>(commit_cursor, commit_end, stamp) ||
+          !readValue<uint32_t>(commit_cursor, commit_end, region_count) ||
+          !readValue<double>(commit_cursor, commit_end, first_ray_time) || region_count != pending.size())
+      {
+        break;
+      }
+
+      scan.regions.insert(scan.regions.end(), pending.begin(), pending.end());
+      scan.stamp = stamp;
+      scan.first_ray_time = first_ray_time;
+      ++scan.delta_count;
+      scan.valid_end = cursor;
+      pending.clear();
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+int replayRegion(const JournalRegion &region, const std::vector<unsigned> &serialised_layers, OccupancyMap &map)
+{
+  const OccupancyMapDetail &detail = *map.detail();
+  const uint8_t *cursor = region.payload;
+  const uint8_t *end = region.payload + region.size;
+
+  bool ok = true;
+  glm::i16vec3 coord;
+  double touched_time = 0;
+  uint64_t dirty_stamp = 0;
+  ok = readValue<int32_t>(cursor, end, coord.x) && ok;
+  ok = readValue<int32_t>(cursor, end, coord.y) && ok;
+  ok = readValue<int32_t>(cursor, end, coord.z) && ok;
+  ok = readValue<double>(cursor, end, touched_time) && ok;
+  ok = readValue<uint64_t>(cursor, end, dirty_stamp) && ok;
+
+  std::vector<IndexedMapFile::LayerEntry> layers(serialised_layers.size());
+  uint64_t blob_size = 0;
+  for (IndexedMapFile::LayerEntry &layer_entry : layers)
+  {
+    ok = readValue<uint64_t>(cursor, end, layer_entry.touched_stamp) && ok;
+    ok = readValue<uint32_t>(cursor, end, layer_entry.encoding) && ok;
+    ok = readValue<uint64_t>(cursor, end, layer_entry.stored_size) && ok;
+    layer_entry.offset = blob_size;
+    blob_size += layer_entry.stored_size;
+  }
+
+  if (!ok || blob_size != uint64_t(end - cursor))
+  {
+    return kSeFileReadFailure;
+  }
+
+  MapChunk *chunk = map.region(coord, true);
+  if (!chunk)
+  {
+    return kSeFileReadFailure;
+  }
+
+  for (size_t i = 0; i < serialised_layers.size(); ++i)
+  {
+    const unsigned layer_index = serialised_layers[i];
+    const MapLayer &layer = detail.layout.layer(layer_index);
+    VoxelBuffer<VoxelBlock> voxel_buffer(chunk->voxel_blocks[layer_index]);
+    const int err = IndexedMapFile::decodeLayer(layers[i], cursor + layers[i].offset, voxel_buffer.voxelMemory(),
+                                                layer.layerByteSize(detail.region_voxel_dimensions),
+                                                layer.voxelByteSize());
+    if (err)
+    {
+      return err;
+    }
+    chunk->touched_stamps[layer_index] = layers[i].touched_stamp;
+  }
+
+  chunk->touched_time = touched_time;
+  chunk->markDirty(dirty_stamp);
+  chunk->searchAndUpdateFirstValid(detail.region_voxel_dimensions);
+
+  return kSeOk;
+}
+}  // namespace
+
+
+int MapJournal::append(const std::string &filename, const OccupancyMap &map, uint64_t from_stamp,
+                       SerialiseProgress *progress, uint64_t *stamp_out)
+{
+  // Ensure paged out regions are considered.
+  map.pageInAllRegions();
+
+  const OccupancyMapDetail &detail = *map.detail();
+  std::vector<uint8_t> header;
+  buildHeader(detail, header);
+
+  bool new_journal = false;
+  {
+    MemoryMappedFile file;
+    if (file.open(filename))
+    {
+      const int err = checkHeader(file.data(), file.size(), header);
+      if (err)
+      {
+        return err;
+      }
+
+      JournalScan scan;
+      scanRecords(file.data() + header.size(), file.data() + file.size(), scan);
+      if (scan.valid_end != file.data() + file.size())
+      {
+        // Incomplete tail from an interrupted write. Appending would leave the new delta unreachable.
+        return kSeJournalCorrupt;
+      }
+    }
+    else
+    {
+      // Either missing or empty. Make sure we do not append to content we could not map.
+      InputStream in(filename);
+      uint8_t byte = 0;
+      if (in.isOpen() && in.readRaw(&byte, 1) == 1)
+      {
+        return kSeFileOpenFailure;
+      }
+      new_journal = true;
+    }
+  }
+
+  OutputStream stream(filename, kSfAppend);
+  if (!stream.isOpen())
+  {
+    return kSeFileCreateFailure;
+  }
+
+  bool ok = true;
+  if (new_journal)
+  {
+    ok = stream.writeUncompressed(header.data(), unsigned(header.size())) == header.size() && ok;
+  }
+
+  std::vector<const MapChunk *> chunks;
+  for (const auto &chunk_ref : detail.chunks)
+  {
+    if (chunk_ref.second->dirty_stamp > from_stamp)
+    {
+      chunks.emplace_back(chunk_ref.second);
+    }
+  }
+
+  if (progress)
+  {
+    progress->setTargetProgress(unsigned(chunks.size()));
+  }
+
+  std::vector<unsigned> serialised_layers;
+  IndexedMapFile::serialisedLayers(detail.layout, serialised_layers);
+
+  std::vector<uint8_t> record;
+  for (size_t i = 0; ok && i < chunks.size(); ++i)
+  {
+    record.clear();
+    const int err = appendRegionRecord(*chunks[i], detail, serialised_layers, record);
+    if (err)
+    {
+      return err;
+    }
+
+    ok = writeRecord(stream, record) && ok;
+
+    if (progress)
+    {
+      progress->incrementProgress();
+    }
+  }
+
+  record.clear();
+  appendCommitRecord(detail, from_stamp, chunks.size(), record);
+  ok = ok && writeRecord(stream, record);
+
+  stream.flush();
+
+  if (!ok)
+  {
+    return kSeFileWriteFailure;
+  }
+
+  if (stamp_out)
+  {
+    *stamp_out = detail.stamp;
+  }
+
+  return kSeOk;
+}
+
+
+int MapJournal::replay(const std::string &filename, OccupancyMap &map, SerialiseProgress *progress,
+                       uint64_t *stamp_out)
+{
+  MemoryMappedFile file;
+  if (!file.open(filename))
+  {
+    return kSeFileOpenFailure;
+  }
+
+  return replay(file.data(), file.size(), map, progress, stamp_out);
+}
+
+
+int MapJournal::replay(const uint8_t *data, size_t byte_count, OccupancyMap &map, SerialiseProgress *progress,
+                       uint64_t *stamp_out)
+{
+  OccupancyMapDetail &detail = *map.detail();
+  std::vector<uint8_t> header;
+  buildHeader(detail, header);
+
+  int err = checkHeader(data, byte_count, header);
+  if (err)
+  {
+    return err;
+  }
+
+  JournalScan scan;
+  scanRecords(data + header.size(), data + byte_count, scan);
+
+  if (progress)
+  {
+    progress->setTargetProgress(unsigned(scan.regions.size()));
+  }
+
+  std::vector<unsigned> serialised_layers;
+  IndexedMapFile::serialisedLayers(detail.layout, serialised_layers);
+
+  for (const JournalRegion &region : scan.regions)
+  {
+    if (progress && progress->quit())
+    {
+      break;
+    }
+
+    err = replayRegion(region, serialised_layers, map);
+    if (err)
+    {
+      return err;
+    }
+
+    if (progress)
+    {
+      progress->incrementProgress();
+    }
+  }
+
+  if (scan.delta_count)
+  {
+    detail.stamp = std::max(detail.stamp.load(), scan.stamp);
+    if (scan.first_ray_time >= 0)
+    {
+      map.updateFirstRayTime(scan.first_ray_time);
+    }
+  }
+
+  if (stamp_out)
+  {
+    *stamp_out = scan.stamp;
+  }
+
+  return kSeOk;
+}
+
+
+int MapJournal::appendRegionRecord(const MapChunk &chunk, const OccupancyMapDetail &detail,
+                                   const std::vector<unsigned> &serialised_layers, std::vector<uint8_t> &buffer)
+{
+  IndexedMapFile::EncodedRegion encoded;
+  IndexedMapFile::encodeRegion(chunk, detail, serialised_layers, true, encoded);
+  if (encoded.error)
+  {
+    return encoded.error;
+  }
+
+  std::vector<uint8_t> payload;
+  appendValue<int32_t>(payload, chunk.region.coord.x);
+  appendValue<int32_t>(payload, chunk.region.coord.y);
+  appendValue<int32_t>(payload, chunk.region.coord.z);
+  appendValue<double>(payload, chunk.touched_time);
+  appendValue<uint64_t>(payload, chunk.dirty_stamp.load());
+  for (const IndexedMapFile::LayerEntry &layer_entry : encoded.layers)
+  {
+    appendValue<uint64_t>(payload, layer_entry.touched_stamp);
+    appendValue<uint32_t>(payload, layer_entry.encoding);
+    appendValue<uint64_t>(payload, layer_entry.stored_size);
+  }
+  payload.insert(payload.end(), encoded.data.begin(), encoded.data.end());
+
+  if (payload.size() != uInt(payload.size()))
+  {
+    return kSeFileWriteFailure;
+  }
+
+  appendRecord(buffer, kRecordRegion, payload.data(), payload.size());
+  return kSeOk;
+}
+
+
+void MapJournal::appendCommitRecord(const OccupancyMapDetail &detail, uint64_t from_stamp, size_t region_count,
+                                    std::vector<uint8_t> &buffer)
+{
+  std::vector<uint8_t> payload;
+  appendValue<uint64_t>(payload, from_stamp);
+  appendValue<uint64_t>(payload, detail.stamp.load());
+  appendValue<uint32_t>(payload, region_count);
+  appendValue<double>(payload, detail.first_ray_time);
+  appendRecord(buffer, kRecordCommit, payload.data(), payload.size());
+}
+
+
+void MapJournal::buildHeader(const OccupancyMapDetail &detail, std::vector<uint8_t> &header)
+{
+  header.clear();
+  appendValue<uint32_t>(header, kMapJournalMarker);
+  appendValue<uint32_t>(header, kJournalVersion.major);
+  appendValue<uint16_t>(header, kJournalVersion.minor);
+  appendValue<uint16_t>(header, kJournalVersion.patch);
+  appendValue<double>(header, detail.resolution);
+  appendValue<int32_t>(header, detail.region_voxel_dimensions.x);
+  appendValue<int32_t>(header, detail.region_voxel_dimensions.y);
+  appendValue<int32_t>(header, detail.region_voxel_dimensions.z);
+  appendValue<double>(header, detail.origin.x);
+  appendValue<double>(header, detail.origin.y);
+  appendValue<double>(header, detail.origin.z);
+  appendValue<uint32_t>(header, unsigned(detail.flags & kVoxelOrderFlags));
+
+  std::vector<unsigned> serialised_layers;
+  IndexedMapFile::serialisedLayers(detail.layout, serialised_layers);
+  appendValue<uint32_t>(header, serialised_layers.size());
+  for (unsigned layer_index : serialised_layers)
+  {
+    const MapLayer &layer = detail.layout.layer(layer_index);
+    const size_t name_length = strlen(layer.name());
+    appendValue<uint32_t>(header, name_length);
+    header.insert(header.end(), layer.name(), layer.name() + name_length);
+    appendValue<uint64_t>(header, layer.layerByteSize(detail.region_voxel_dimensions));
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,115 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPJOURNAL_H
+#define OHM_MAPJOURNAL_H
+
+#include "OhmConfig.h"
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+class SerialiseProgress;
+struct MapChunk;
+struct OccupancyMapDetail;
+
+/// Append only map journal supporting @c ohm::saveDelta() and @c ohm::loadDelta() .
+///
+/// A journal records a sequence of deltas, each containing the regions changed since a given stamp. The file is
+/// written uncompressed, with each region's layers independently compressed as for @c IndexedMapFile . The format is:
+/// - Journal header:
+///   - @c uint32_t journal marker
+///   - @c uint32_t major, @c uint16_t minor, @c uint16_t patch version numbers
+///   - @c double map resolution
+///   - @c int32_t region voxel dimensions x, y, z
+///   - @c double map origin x, y, z
+///   - @c uint32_t voxel order @c MapFlag bits - see @c kVoxelOrderFlags
+///   - @c uint32_t serialised layer count: the number of layers without @c MapLayer::kSkipSerialise
+///   - For each serialised layer: @c uint32_t name length, name characters, @c uint64_t layer byte size per region
+/// - Records, each starting with:
+///   - @c uint32_t record marker
+///   - @c uint32_t @c RecordType
+///   - @c uint64_t payload byte size
+///   - @c uint32_t payload CRC32
+///
+/// A delta is a sequence of @c kRecordRegion records followed by a single @c kRecordCommit record. Region payloads
+/// hold the @c int32_t region coordinates, @c double touched time and @c uint64_t @c MapChunk::dirty_stamp followed
+/// by the touched stamp, encoding and stored size of each serialised layer, then the layer blobs. The commit payload
+/// holds the delta's from stamp, the map stamp, the region count and the first ray time.
+///
+/// Only committed deltas are replayed, so a journal truncated by an interrupted write is recovered up to the last
+/// complete delta. Such a journal cannot be appended to.
+class MapJournal
+{
+public:
+  /// Journal record types.
+  enum RecordType : uint32_t
+  {
+    /// A region changed in the current delta.
+    kRecordRegion = 1u,
+    /// Completes the current delta.
+    kRecordCommit = 2u
+  };
+
+  /// Append a delta to the journal at @p filename containing the regions of @p map dirtied after @p from_stamp .
+  /// The journal is created if it does not exist.
+  /// @param filename The journal path.
+  /// @param map The map to write regions from.
+  /// @param from_stamp Write regions with a @c MapChunk::dirty_stamp greater than this value.
+  /// @param progress Optional progress reporting. Progress is incremented for each region written.
+  /// @param[out] stamp_out Optionally set to the map stamp recorded for the delta.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  static int append(const std::string &filename, const OccupancyMap &map, uint64_t from_stamp,
+                    SerialiseProgress *progress, uint64_t *stamp_out);
+
+  /// Replay all committed deltas in the journal at @p filename onto @p map .
+  /// @param filename The journal path.
+  /// @param map The map to update. Must match the resolution, region dimensions and layout of the journal.
+  /// @param progress Optional progress reporting. Progress is incremented for each region replayed.
+  /// @param[out] stamp_out Optionally set to the map stamp of the last delta replayed.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  static int replay(const std::string &filename, OccupancyMap &map, SerialiseProgress *progress,
+                    uint64_t *stamp_out);
+
+  /// Replay all committed deltas in the in memory journal @p data onto @p map . The journal must start with the
+  /// header. This supports journals transferred as byte buffers - see @c MapDeltaEncoder .
+  /// @param data The journal bytes.
+  /// @param byte_count Number of bytes in @p data .
+  /// @param map The map to update. Must match the resolution, region dimensions and layout of the journal.
+  /// @param progress Optional progress reporting. Progress is incremented for each region replayed.
+  /// @param[out] stamp_out Optionally set to the map stamp of the last delta replayed.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  static int replay(const uint8_t *data, size_t byte_count, OccupancyMap &map, SerialiseProgress *progress,
+                    uint64_t *stamp_out);
+
+  /// Build the expected journal header bytes for @p detail .
+  /// @param detail The map detail.
+  /// @param[out] header The header bytes.
+  static void buildHeader(const OccupancyMapDetail &detail, std::vector<uint8_t> &header);
+
+  /// Append a @c kRecordRegion record for @p chunk to @p buffer .
+  /// @param chunk The region to encode.
+  /// @param detail The map detail.
+  /// @param serialised_layers The layers to encode. See @c IndexedMapFile::serialisedLayers() .
+  /// @param[out] buffer The buffer to append the record to.
+  /// @return @c kSeOk on success or a @c SerialisationError code on failure.
+  static int appendRegionRecord(const MapChunk &chunk, const OccupancyMapDetail &detail,
+                                const std::vector<unsigned> &serialised_layers, std::vector<uint8_t> &buffer);
+
+  /// Append a @c kRecordCommit record to @p buffer completing a delta of @p region_count regions.
+  /// @param detail The map detail.
+  /// @param from_stamp The delta from stamp.
+  /// @param region_count The number of region records in the delta.
+  /// @param[out] buffer The buffer to append the record to.
+  static void appendCommitRecord(const OccupancyMapDetail &detail, uint64_t from_stamp, size_t region_count,
+                                 std::vector<uint8_t> &buffer);
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPJOURNAL_H
@@ -0,0 +1,39 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPPYRAMIDDETAIL_H
+#define OHM_MAPPYRAMIDDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "MapPyramid.h"
+#include "OccupancyMap.h"
+#include "RegionScheduler.h"
+
+#include <glm/vec3.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+struct MapPyramidDetail
+{
+  /// The coarse level maps. Item zero is level 1. Empty until the first update.
+  std::vector<std::unique_ptr<OccupancyMap>> levels;
+  /// Source regions awaiting an update.
+  RegionScheduler pending;
+  /// Source map stamp at which dirty regions were last collected.
+  uint64_t last_stamp = 0;
+  /// Source map @c OccupancyMap::rebaseOffset() at the last update. Used to detect a rebase.
+  glm::dvec3 rebase_offset = glm::dvec3(0);
+  /// Number of coarse levels to maintain.
+  unsigned level_count = 0;
+  /// Pooling operation.
+  PyramidPooling pooling = PyramidPooling::kMax;
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPPYRAMIDDETAIL_H
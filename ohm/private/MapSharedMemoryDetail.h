@@ -0,0 +1,179 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MAPSHAREDMEMORYDETAIL_H
+#define OHM_MAPSHAREDMEMORYDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "MapRegion.h"
+#include "SharedMemorySegment.h"
+
+#include <glm/vec3.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+/// Shared segment layout for @c MapSharedPublisher and @c MapSharedReader . The segment holds a
+/// @c SharedMapHeader , followed by the region directory of @c SharedMapEntry items, then one fixed size voxel slot
+/// per directory entry.
+///
+/// The directory is an open addressing hash table with linear probing, written only by the publisher. Each entry
+/// holds a sequence lock: the sequence is odd while the publisher updates the entry and readers retry reads which
+/// overlap an update. Atomics must be lock free and address free to be shared between processes.
+namespace sharedmap
+{
+/// Segment identifier. Written last by the publisher, so readers never see a partially initialised header.
+constexpr uint32_t kMagic = 0x4d53686fu;
+/// Segment layout version.
+constexpr uint32_t kVersion = 2u;
+/// Maximum number of published layers.
+constexpr unsigned kMaxLayers = 16u;
+/// Layer name storage size, including the null terminator.
+constexpr size_t kLayerNameSize = 48u;
+/// Alignment of the directory and each voxel slot.
+constexpr size_t kAlignment = 64u;
+/// @c SharedMapEntry::key value for an unused entry.
+constexpr uint64_t kEntryEmpty = 0u;
+/// @c SharedMapEntry::key value for a removed entry. Lookups continue probing past removed entries.
+constexpr uint64_t kEntryRemoved = 1u;
+/// Number of times a reader retries a read which overlaps a publisher update.
+constexpr unsigned kReadAttempts = 64u;
+
+static_assert(sizeof(std::atomic_uint64_t) == sizeof(uint64_t), "Shared atomics must match the plain type size");
+
+/// Describes a layer published in each voxel slot.
+struct SharedMapLayerInfo
+{
+  char name[kLayerNameSize];  ///< Layer name. NOLINT(modernize-avoid-c-arrays)
+  uint64_t slot_offset;       ///< Byte offset of the layer voxels in a slot.
+  uint64_t byte_size;         ///< Byte size of the layer voxels in a slot.
+  uint32_t voxel_size;        ///< Byte size of each voxel.
+  uint32_t voxel_stride;      ///< Bytes between voxels. Differs from @c voxel_size for a layer group member.
+  uint32_t voxel_offset;      ///< Byte offset of the voxel data within the stride for a layer group member.
+  uint8_t dim[3];             ///< Layer voxel dimensions. NOLINT(modernize-avoid-c-arrays)
+  uint8_t subsampling;        ///< Layer subsampling shift.
+  uint8_t voxel_order;        ///< The @c VoxelOrder of the layer voxels - see @c OccupancyMap::layerVoxelOrder() .
+  uint8_t reserved[3];        ///< Padding. NOLINT(modernize-avoid-c-arrays)
+};
+
+/// Segment header.
+struct SharedMapHeader
+{
+  std::atomic_uint32_t magic;         ///< @c kMagic once initialised.
+  uint32_t version;                   ///< @c kVersion
+  uint64_t segment_size;              ///< Total segment byte size.
+  double resolution;                  ///< Map voxel resolution.
+  double origin[3];                   ///< Map origin. NOLINT(modernize-avoid-c-arrays)
+  uint8_t region_dim[3];              ///< Region voxel dimensions. NOLINT(modernize-avoid-c-arrays)
+  uint8_t reserved;                   ///< Padding.
+  uint32_t layer_count;               ///< Number of items in @c layers .
+  uint64_t capacity;                  ///< Number of directory entries and voxel slots. A power of two.
+  uint64_t slot_size;                 ///< Byte size of each voxel slot.
+  uint64_t directory_offset;          ///< Byte offset to the directory.
+  uint64_t slot_offset;               ///< Byte offset to the first voxel slot.
+  std::atomic_uint64_t epoch;         ///< Incremented after each publish.
+  std::atomic_uint64_t map_stamp;     ///< @c OccupancyMap::stamp() at the last publish.
+  std::atomic_uint64_t region_count;  ///< Number of published regions.
+  SharedMapLayerInfo layers[kMaxLayers];  ///< Published layers. NOLINT(modernize-avoid-c-arrays)
+};
+
+/// A region directory entry.
+struct SharedMapEntry
+{
+  std::atomic_uint64_t key;       ///< Key from @c packRegionKey() , or @c kEntryEmpty / @c kEntryRemoved .
+  std::atomic_uint64_t sequence;  ///< Sequence lock. Odd while the entry is being written.
+  std::atomic_uint64_t stamp;     ///< Region touched stamp at the last publish.
+  std::atomic_uint64_t epoch;     ///< Publish epoch at which the region was last written.
+};
+
+/// Pack a region key into a directory key. Never matches @c kEntryEmpty or @c kEntryRemoved .
+/// @param region_key The region key.
+/// @return The packed key.
+inline uint64_t packRegionKey(const glm::i16vec3 &region_key)
+{
+  const uint64_t kValidBit = uint64_t(1u) << 48u;
+  return uint64_t(uint16_t(region_key.x)) | (uint64_t(uint16_t(region_key.y)) << 16u) |
+         (uint64_t(uint16_t(region_key.z)) << 32u) | kValidBit;
+}
+
+/// Unpack a directory key from @c packRegionKey() .
+/// @param packed The packed key.
+/// @return The region key.
+inline glm::i16vec3 unpackRegionKey(uint64_t packed)
+{
+  return glm::i16vec3(int16_t(uint16_t(packed & 0xffffu)), int16_t(uint16_t((packed >> 16u) & 0xffffu)),
+                      int16_t(uint16_t((packed >> 32u) & 0xffffu)));
+}
+
+/// Calculate the home directory entry for a packed key.
+/// @param packed The packed key.
+/// @param capacity The directory capacity. Must be a power of two.
+/// @return The first entry index to probe.
+inline uint64_t homeEntry(uint64_t packed, uint64_t capacity)
+{
+  // splitmix64 finaliser to spread the packed coordinates.
+  packed ^= packed >> 30u;
+  packed *= 0xbf58476d1ce4e5b9ull;
+  packed ^= packed >> 27u;
+  packed *= 0x94d049bb133111ebull;
+  packed ^= packed >> 31u;
+  return packed & (capacity - 1u);
+}
+
+/// Round @p value up to a multiple of @c kAlignment .
+/// @param value The value to align.
+/// @return The aligned value.
+inline uint64_t align(uint64_t value)
+{
+  return (value + kAlignment - 1u) & ~uint64_t(kAlignment - 1u);
+}
+}  // namespace sharedmap
+
+/// Source of a published layer.
+struct SharedMapLayerSource
+{
+  /// Index of the layer storing the voxel blocks. The group layer for a layer group member.
+  unsigned block_layer = 0;
+  /// Index of the requested layer, used for touched stamps.
+  unsigned layer = 0;
+  /// Byte offset of the block in each voxel slot.
+  uint64_t slot_offset = 0;
+  /// False when the block is copied for an earlier layer sharing the same group layer.
+  bool copy = true;
+};
+
+/// Internal state for @c MapSharedPublisher .
+struct MapSharedPublisherDetail
+{
+  SharedMemorySegment segment;
+  sharedmap::SharedMapHeader *header = nullptr;
+  sharedmap::SharedMapEntry *entries = nullptr;
+  uint8_t *slots = nullptr;
+  std::vector<SharedMapLayerSource> sources;
+  /// Directory entry for each published region.
+  std::unordered_map<glm::i16vec3, uint64_t, MapRegion::Hash> published;
+  /// Regions skipped in the last publish because the directory was full.
+  size_t dropped_count = 0;
+  std::string name;
+};
+
+/// Internal state for @c MapSharedReader .
+struct MapSharedReaderDetail
+{
+  SharedMemorySegment segment;
+  const sharedmap::SharedMapHeader *header = nullptr;
+  const sharedmap::SharedMapEntry *entries = nullptr;
+  const uint8_t *slots = nullptr;
+  glm::dvec3 region_spatial_dim{ 0 };
+};
+}  // namespace ohm
+
+#endif  // OHM_MAPSHAREDMEMORYDETAIL_H
@@ -8,6 +8,13 @@
 
 #include "OhmConfig.h"
 
+#include <glm/vec3.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/task_arena.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <memory>
 #include <vector>
 
 namespace ohm
@@ -20,6 +27,16 @@ struct ohm_API MapperDetail
   std::vector<MappingProcess *> processes;
   OccupancyMap *map = nullptr;
   unsigned next_process = 0;
+  glm::dvec3 reference_position{ 0.0 };
+  bool has_reference_position = false;
+  /// Run processes concurrently?
+  bool concurrent = false;
+  /// Maximum threads for concurrent processing. Zero for default.
+  unsigned thread_count = 0;
+#ifdef OHM_FEATURE_THREADS
+  /// Arena used for concurrent processes with a non-zero @c thread_count . Created on demand.
+  std::unique_ptr<tbb::task_arena> arena;
+#endif  // OHM_FEATURE_THREADS
 };
 }  // namespace ohm
 
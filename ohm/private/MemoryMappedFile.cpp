@@ -0,0 +1,120 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MemoryMappedFile.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+#else  // _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+namespace ohm
+{
+MemoryMappedFile::~MemoryMappedFile()
+{
+  close();
+}
+
+
+bool MemoryMappedFile::open(const std::string &filename)
+{
+  close();
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  file_handle_ = file;
+  mapping_handle_ = mapping;
+  data_ = static_cast<const uint8_t *>(view);
+  size_ = size_t(file_size.QuadPart);
+#else   // _WIN32
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat file_stat = {};
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  const auto file_size = size_t(file_stat.st_size);
+  void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping remains valid after closing the file descriptor.
+  ::close(fd);
+  if (mapped == MAP_FAILED)  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  {
+    return false;
+  }
+
+  // Regions are paged in on demand with no particular order.
+  madvise(mapped, file_size, MADV_RANDOM);
+
+  data_ = static_cast<const uint8_t *>(mapped);
+  size_ = file_size;
+#endif  // _WIN32
+  return true;
+}
+
+
+void MemoryMappedFile::close()
+{
+  if (!data_)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_handle_);
+  CloseHandle(file_handle_);
+  mapping_handle_ = file_handle_ = nullptr;
+#else   // _WIN32
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+  munmap(const_cast<uint8_t *>(data_), size_);
+#endif  // _WIN32
+  data_ = nullptr;
+  size_ = 0;
+}
+}  // namespace ohm
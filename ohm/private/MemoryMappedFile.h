@@ -0,0 +1,59 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_MEMORYMAPPEDFILE_H
+#define OHM_MEMORYMAPPEDFILE_H
+
+#include "OhmConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ohm
+{
+/// A minimal read only memory mapped file. The whole file is mapped on @c open() .
+class MemoryMappedFile
+{
+public:
+  /// Constructor: nothing mapped.
+  MemoryMappedFile() = default;
+  /// Destructor: unmaps the file.
+  ~MemoryMappedFile();
+
+  MemoryMappedFile(const MemoryMappedFile &) = delete;
+  MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+  /// Open and map @p filename for reading. Any currently mapped file is closed first.
+  /// @param filename The file to map.
+  /// @return True on success.
+  bool open(const std::string &filename);
+
+  /// Unmap the current file.
+  void close();
+
+  /// Check if a file is mapped.
+  /// @return True when mapped.
+  inline bool isOpen() const { return data_ != nullptr; }
+
+  /// Access the mapped file content.
+  /// @return The mapped content or null when not open.
+  inline const uint8_t *data() const { return data_; }
+
+  /// Query the mapped byte size.
+  /// @return The file size in bytes.
+  inline size_t size() const { return size_; }
+
+private:
+  const uint8_t *data_ = nullptr;  ///< Mapped file data.
+  size_t size_ = 0;                ///< Mapped byte size.
+#ifdef _WIN32
+  void *file_handle_ = nullptr;     ///< Win32 file handle.
+  void *mapping_handle_ = nullptr;  ///< Win32 file mapping handle.
+#endif                              // _WIN32
+};
+}  // namespace ohm
+
+#endif  // OHM_MEMORYMAPPEDFILE_H
@@ -42,6 +42,8 @@ struct NdtMapDetail
   NdtMode mode = NdtMode::kOccupancy;
   /// True if @p map is a borrowed pointer, false to take ownership and delete it.
   bool borrowed_map = false;
+  /// Use single precision maths for the CPU covariance hit update? See @c calculateHitWithCovarianceBatch() .
+  bool single_precision_covariance = false;
   /// Debug tracing enabled? Requires 3es
   bool trace = false;
 };
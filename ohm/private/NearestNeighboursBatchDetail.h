@@ -0,0 +1,30 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_NEARESTNEIGHBOURSBATCHDETAIL_H
+#define OHM_NEARESTNEIGHBOURSBATCHDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "QueryDetail.h"
+
+#include <glm/vec3.hpp>
+
+namespace ohm
+{
+/// Pimpl data for @c NearestNeighboursBatch
+struct ohm_API NearestNeighboursBatchDetail : QueryDetail
+{
+  std::vector<glm::dvec3> near_points;  ///< The query points to search around.
+  float search_radius = 0;              ///< Search radius around each query point.
+  /// Results vector, identifying the offsets for each query point into @c intersected_voxels where the results for
+  /// that point begin.
+  std::vector<size_t> result_indices;
+  /// Results vector, identifying the number of voxels for each query point in @c intersected_voxels.
+  std::vector<size_t> result_counts;
+};
+}  // namespace ohm
+
+#endif  // OHM_NEARESTNEIGHBOURSBATCHDETAIL_H
@@ -5,6 +5,11 @@
 // Author: Kazys Stepanas
 #include "OccupancyMapDetail.h"
 
+#include "IndexedMapFile.h"
+#include "RegionChangeFeedDetail.h"
+#include "RegionPager.h"
+#include "RollingWindow.h"
+
 #include "DefaultLayer.h"
 #include "MapLayer.h"
 #include "MapLayout.h"
@@ -21,6 +26,31 @@ namespace ohm
 OccupancyMapDetail::~OccupancyMapDetail()
 {
   delete gpu_cache;
+  std::unique_lock<Mutex> guard(change_feed_mutex);
+  for (RegionChangeFeedDetail *feed : change_feeds)
+  {
+    feed->map = nullptr;
+  }
+}
+
+
+void OccupancyMapDetail::notifyChangeFeeds(const glm::i16vec3 &region_key) const
+{
+  std::unique_lock<Mutex> guard(change_feed_mutex);
+  for (RegionChangeFeedDetail *feed : change_feeds)
+  {
+    feed->push(region_key);
+  }
+}
+
+
+void OccupancyMapDetail::notifyRebase(const glm::dvec3 &region_shift) const
+{
+  std::unique_lock<Mutex> guard(change_feed_mutex);
+  for (RegionChangeFeedDetail *feed : change_feeds)
+  {
+    feed->rebase(region_shift);
+  }
 }
 
 
@@ -38,6 +68,13 @@ void OccupancyMapDetail::moveKeyAlongAxis(Key &key, int axis, int step, const gl
   // stepped local axis value.
   glm::i16vec3 region_key = key.regionKey();
   glm::ivec3 local_key = key.localKey();
+  if (local_key[axis] + step >= 0 && local_key[axis] + step < local_limits[axis])
+  {
+    // Remain in the same region: no division required.
+    key.setLocalAxis(axis, uint8_t(local_key[axis] + step));
+    return;
+  }
+
   if (step > 0)
   {
     // Positive step.
@@ -141,6 +178,16 @@ void OccupancyMapDetail::setDefaultLayout(MapFlag init_flags)
     flags &= ~MapFlag::kIncidentNormal;
   }
 
+  if ((init_flags & MapFlag::kTouchIncident) != MapFlag::kNone)
+  {
+    addTouchIncident(layout);
+    flags |= MapFlag::kTouchIncident;
+  }
+  else
+  {
+    flags &= ~MapFlag::kTouchIncident;
+  }
+
   if ((init_flags & MapFlag::kTsdf) != MapFlag::kNone)
   {
     addTsdf(layout);
@@ -160,16 +207,41 @@ void OccupancyMapDetail::setDefaultLayout(MapFlag init_flags)
   {
     flags &= ~MapFlag::kSecondarySample;
   }
+
+  // The occupancy state layer packs 2x2x2 voxel blocks so requires even region dimensions.
+  const bool even_dimensions = (region_voxel_dimensions.x % 2 == 0) && (region_voxel_dimensions.y % 2 == 0) &&
+                               (region_voxel_dimensions.z % 2 == 0);
+  if ((init_flags & MapFlag::kOccupancyState) != MapFlag::kNone && even_dimensions)
+  {
+    addOccupancyState(layout);
+    flags |= MapFlag::kOccupancyState;
+  }
+  else
+  {
+    flags &= ~MapFlag::kOccupancyState;
+  }
+
+  // Group after adding all the layers to interleave.
+  if ((init_flags & MapFlag::kInterleavedLayers) != MapFlag::kNone && addOccupancyGroup(layout))
+  {
+    flags |= MapFlag::kInterleavedLayers;
+  }
+  else
+  {
+    flags &= ~MapFlag::kInterleavedLayers;
+  }
 }
 
 
 void OccupancyMapDetail::copyFrom(const OccupancyMapDetail &other)
 {
   origin = other.origin;
+  rebase_offset = other.rebase_offset;
   region_spatial_dimensions = other.region_spatial_dimensions;
   region_voxel_dimensions = other.region_voxel_dimensions;
+  region_indexer = other.region_indexer;
   resolution = other.resolution;
-  stamp = other.stamp;
+  stamp = other.stamp.load();
   occupancy_threshold_value = other.occupancy_threshold_value;
   hit_value = other.hit_value;
   miss_value = other.miss_value;
@@ -177,6 +249,7 @@ void OccupancyMapDetail::copyFrom(const OccupancyMapDetail &other)
   max_voxel_value = other.max_voxel_value;
   saturate_at_min_value = other.saturate_at_min_value;
   saturate_at_max_value = other.saturate_at_max_value;
+  occupancy_decay_time = other.occupancy_decay_time;
   layout = MapLayout(other.layout);
   flags = other.flags;
 }
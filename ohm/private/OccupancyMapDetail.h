@@ -12,31 +12,29 @@
 #include "ohm/MapFlag.h"
 #include "ohm/MapInfo.h"
 #include "ohm/MapLayout.h"
+#include "ohm/MapMemoryAccounting.h"
 #include "ohm/MapRegion.h"
 #include "ohm/Mutex.h"
 #include "ohm/RayFilter.h"
+#include "ohm/RegionIndexer.h"
 
-#include <ohmutil/VectorHash.h>
-
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wconversion"
-#endif  // __GNUC__
-#include <ska/bytell_hash_map.hpp>
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif  // __GNUC__
+#include "ChunkMap.h"
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
 
 namespace ohm
 {
-using ChunkMap = ska::bytell_hash_map<glm::i16vec3, MapChunk *, Vector3Hash<glm::i16vec3>>;
-
+class IndexedMapFile;
 class MapRegionCache;
 class OccupancyMap;
+class RegionPager;
+struct RegionChangeFeedDetail;
+class RollingWindow;
+class VoxelMemoryPool;
 
 /// Internal details associated with an @c OccupancyMap .
 struct ohm_API OccupancyMapDetail
@@ -46,20 +44,25 @@ struct ohm_API OccupancyMapDetail
 
   /// A global origin offset for data in the map. All data read from the map has this origin added.
   glm::dvec3 origin = glm::dvec3(0);
+  /// Accumulated region key shift applied by @c OccupancyMap::rebaseOrigin() . See @c OccupancyMap::rebaseOffset() .
+  glm::dvec3 rebase_offset = glm::dvec3(0);
   /// The spatial dimensions of each region. Calculated as `region_voxel_dimensions * resolution`.
   /// Each axis may have a different spatial length.
   glm::dvec3 region_spatial_dimensions = glm::dvec3(0);
   /// The voxel dimensions of each region - i.e., the number of voxels along each axis for a map region.
   /// Each axis may have a different voxel length.
   glm::u8vec3 region_voxel_dimensions = glm::u8vec3(0);
+  /// Index arithmetic for the @c region_voxel_dimensions . Must be updated whenever the dimensions change.
+  RegionIndexer region_indexer;
   /// The size of a voxel cube edge. All voxels are uniform cubes.
   double resolution = 0.0;
   /// The timestamp of the first ray added to the map. This is only value if >= 0 and should be set once only.
   /// @note Timestamps may be unavailable.
   double first_ray_time = -1;
   /// Used to mark changes in the map. This is a monotonic value which is modified when the map is changed and is
-  /// copied into associated @c MapChunk objects. This can be used to detect the recency of changes.
-  uint64_t stamp = 0;
+  /// copied into associated @c MapChunk objects. This can be used to detect the recency of changes. Atomic so
+  /// concurrently running @c MappingProcess objects may touch the map.
+  std::atomic_uint64_t stamp{ 0 };
   /// The value threshold used to consider a voxel as occupied. Occupied voxels have a value equal to or greater than
   /// this value, but not equal to @c ohm::unobservedOccupancyValue() (infinity).
   /// @see @c ohm::valueToProbability()
@@ -78,13 +81,18 @@ struct ohm_API OccupancyMapDetail
   bool saturate_at_min_value = false;
   /// Flag indicating voxels become locked and cannot be changed when they reach @c max_voxel_value .
   bool saturate_at_max_value = false;
+  /// Time constant (seconds) for the lazy decay of observed occupancy values. Zero to disable.
+  /// See @c OccupancyMap::setOccupancyDecayTime() .
+  double occupancy_decay_time = 0;
   /// Map control flags.
   MapFlag flags = MapFlag::kNone;
   /// The voxel memory layout information for the map.
   MapLayout layout;
-  /// The hash map of @c MapChunk objects contained in this map.
+  /// The hash map of @c MapChunk objects contained in this map. Supports lock-free lookup and concurrent
+  /// insertion/removal. See @c ChunkMap .
   ChunkMap chunks;
-  /// Data access mutex. Used to protect @c chunks .
+  /// Data access mutex. Used to serialise structural changes to the map such as @c OccupancyMap::clear() and layout
+  /// changes as well as access to the @c gpu_cache . Not required to lookup, insert or remove @c chunks .
   mutable Mutex mutex;
   // Region count at load time. Useful when only the header is loaded.
   size_t loaded_region_count = 0;
@@ -97,15 +105,44 @@ struct ohm_API OccupancyMapDetail
 
   /// Optional function to be called for each input ray before processing. See @c RayFilterFunction documentation.
   RayFilterFunction ray_filter;
+  /// Optional batch ray filter, preferred over the @c ray_filter where supported. See @c RayBatchFilterFunction .
+  RayBatchFilterFunction ray_batch_filter;
+
+  /// Memory mapped map file from which regions are loaded on demand. Only set when opened via @c ohm::openIndexed()
+  /// and released once all regions are loaded. See @c OccupancyMap::region() . Shared with any @c VoxelBlock with
+  /// deferred layer data from the file.
+  std::shared_ptr<IndexedMapFile> indexed_file;
+
+  /// Backing store for regions paged out of memory. Only set when region paging is enabled.
+  /// See @c OccupancyMap::enableRegionPaging() .
+  std::unique_ptr<RegionPager> pager;
+
+  /// Ring buffer region store used in rolling window mode. Only set when the rolling window is enabled.
+  /// See @c OccupancyMap::enableRollingWindow() .
+  std::unique_ptr<RollingWindow> rolling_window;
 
   /// Meta information storage about the map.
   /// The data stored are arbitrary key/value pairs. Generally it is expected that this may hold data about how
   /// the map was generated or has been modified.
   MapInfo info;
 
+  /// Pool allocating and recycling the voxel memory of the map's @c VoxelBlock objects. Shared with the blocks.
+  std::shared_ptr<VoxelMemoryPool> memory_pool;
+  /// Live voxel memory accounting and budget for the map. Shared with the blocks.
+  std::shared_ptr<MapMemoryAccounting> memory_accounting;
+  /// Invoked by @c OccupancyMap::enforceMemoryBudget() when compression fails to meet the budget.
+  MemoryBudgetFunction on_memory_budget;
+
+  /// Subscribed @c RegionChangeFeed objects, notified by @c notifyRegionChanged() .
+  std::vector<RegionChangeFeedDetail *> change_feeds;
+  /// Number of @c change_feeds . Allows @c notifyRegionChanged() to skip locking when there are no subscribers.
+  std::atomic_uint change_feed_count{ 0 };
+  /// Protects @c change_feeds .
+  mutable Mutex change_feed_mutex;
+
   /// Default constructor.
   OccupancyMapDetail() = default;
-  /// Destructor ensures @c gpu_cache is destroyed.
+  /// Destructor ensures @c gpu_cache is destroyed and detaches any @c change_feeds .
   ~OccupancyMapDetail();
 
   /// Move an @c Key along a selected axis.
@@ -119,9 +156,28 @@ struct ohm_API OccupancyMapDetail
   /// @overload
   inline void moveKeyAlongAxis(Key &key, int axis, int step) const
   {
-    moveKeyAlongAxis(key, axis, step, region_voxel_dimensions);
+    region_indexer.moveKeyAlongAxis(key, axis, step);
+  }
+
+  /// Notify the subscribed @c change_feeds that the region at @p region_key has changed. Called when the
+  /// @c MapChunk::dirty_stamp advances - see @c MapChunk::markDirty() .
+  /// @param region_key The changed region.
+  inline void notifyRegionChanged(const glm::i16vec3 &region_key) const
+  {
+    if (change_feed_count.load(std::memory_order_relaxed))
+    {
+      notifyChangeFeeds(region_key);
+    }
   }
 
+  /// Notify all @c change_feeds of a change to @p region_key . Implements @c notifyRegionChanged() .
+  /// @param region_key The changed region.
+  void notifyChangeFeeds(const glm::i16vec3 &region_key) const;
+
+  /// Notify all @c change_feeds that the region keys have been shifted by @c OccupancyMap::rebaseOrigin() .
+  /// @param region_shift The region key shift. See @c OccupancyMap::shiftRegionKey() .
+  void notifyRebase(const glm::dvec3 &region_shift) const;
+
   /// Setup the default @c MapLayout: occupancy layer and clearance layer.
   /// @param init_flags Flags identifying how to initialise the layers. Only considers flags relating to voxel layers.
   ///   The @p flags member is updated accordingly.
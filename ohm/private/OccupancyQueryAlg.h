@@ -9,6 +9,7 @@
 #include "OhmConfig.h"
 
 #include "ohm/OccupancyMap.h"
+#include "ohm/TaskArena.h"
 
 #include "ohm/private/OccupancyMapDetail.h"
 #include "ohm/private/QueryDetail.h"
@@ -87,25 +88,27 @@ unsigned occupancyQueryRegionsParallel(
   min_region_key = map.regionKey(query_min_extents);
   max_region_key = map.regionKey(query_max_extents);
 
-  tbb::parallel_for(
-    tbb::blocked_range3d<size_t>(max_region_key.z, max_region_key.z + 1, max_region_key.y, max_region_key.y + 1,
-                                 max_region_key.x, max_region_key.x + 1),
-    [&current_neighbours, &map, &query, &closest, &region_query_func](const tbb::blocked_range3d<int> &range) {
-      glm::i16vec3 region_key;
-      for (int z = range.pages().begin(); z != range.pages().end(); ++z)
-      {
-        region_key.z = z;
-        for (int y = range.rows().begin(); y != range.rows().end(); ++y)
+  parallelExecute([&]() {
+    tbb::parallel_for(
+      tbb::blocked_range3d<size_t>(max_region_key.z, max_region_key.z + 1, max_region_key.y, max_region_key.y + 1,
+                                   max_region_key.x, max_region_key.x + 1),
+      [&current_neighbours, &map, &query, &closest, &region_query_func](const tbb::blocked_range3d<int> &range) {
+        glm::i16vec3 region_key;
+        for (int z = range.pages().begin(); z != range.pages().end(); ++z)
         {
-          region_key.y = y;
-          for (int x = range.cols().begin(); x != range.cols().end(); ++x)
+          region_key.z = z;
+          for (int y = range.rows().begin(); y != range.rows().end(); ++y)
           {
-            region_key.x = x;
-            current_neighbours += region_query_func(map, query, region_key, closest);
+            region_key.y = y;
+            for (int x = range.cols().begin(); x != range.cols().end(); ++x)
+            {
+              region_key.x = x;
+              current_neighbours += region_query_func(map, query, region_key, closest);
+            }
           }
         }
-      }
-    });
+      });
+  });
 
   return current_neighbours;
 #else   // OHM_FEATURE_THREADS
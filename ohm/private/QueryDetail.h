@@ -10,12 +10,16 @@
 
 #include "ohm/Key.h"
 
+#include <chrono>
+#include <functional>
+#include <future>
 #include <limits>
 #include <vector>
 
 namespace ohm
 {
 class OccupancyMap;
+class Query;
 
 /// Pimpl data for @c Query objects .
 struct ohm_API QueryDetail
@@ -30,9 +34,40 @@ struct ohm_API QueryDetail
   size_t number_of_results = 0;
   /// @c QueryFlag values for the query.
   unsigned query_flags = 0;
+  /// Allow CPU query evaluation to use multiple threads? Only effective with @c OHM_FEATURE_THREADS .
+  bool use_threads = true;
+  /// Pending result for a query executing asynchronously on the CPU (if used and valid).
+  std::future<bool> cpu_async;
+  /// Completion function for the current asynchronous query. See @c Query::CompletionFunction .
+  std::function<void(Query &, bool)> on_complete;
 
   /// Virtual destructor.
   virtual ~QueryDetail() = default;
+
+  /// Check if a CPU asynchronous query is running or awaiting collection.
+  /// @return True if @c cpu_async is pending.
+  inline bool cpuAsyncPending() const { return cpu_async.valid(); }
+
+  /// Wait for the @c cpu_async query to complete.
+  /// @param timeout_ms Maximum time to wait (milliseconds) or ~0u to wait indefinitely.
+  /// @return True if there is no CPU asynchronous query running on return.
+  inline bool waitCpuAsync(unsigned timeout_ms)
+  {
+    if (!cpu_async.valid())
+    {
+      return true;
+    }
+
+    // Note: std::future::wait_for() blocks on the completion signal. It does not spin.
+    if (timeout_ms != ~0u &&
+        cpu_async.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready)
+    {
+      return false;
+    }
+
+    cpu_async.get();
+    return true;
+  }
 };
 
 /// Query result helper identifying the closest result index.
@@ -0,0 +1,98 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_QUERYREGIONCACHE_H
+#define OHM_QUERYREGIONCACHE_H
+
+#include "OhmConfig.h"
+
+#include "ohm/MapChunk.h"
+#include "ohm/MapLayout.h"
+#include "ohm/OccupancyMap.h"
+#include "ohm/OccupancySummary.h"
+#include "ohm/VoxelBlock.h"
+#include "ohm/VoxelBuffer.h"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+namespace ohm
+{
+/// A region retained by a @c QueryRegionCache .
+struct QueryCachedRegion
+{
+  /// The region key.
+  glm::i16vec3 region_key{ 0 };
+  /// The region chunk. Null when the region does not exist.
+  const MapChunk *chunk = nullptr;
+  /// The retained voxel buffer for the cached layer. Invalid when @c chunk is null.
+  VoxelBuffer<const VoxelBlock> buffer;
+  /// The current occupancy summary for the region. Only set when caching the occupancy layer.
+  const RegionOccupancySummary *summary = nullptr;
+};
+
+/// Retains the @c VoxelBuffer of a single layer for the most recently visited regions, evicting the oldest region
+/// first. This is intended for query workers which visit the same few regions repeatedly, such as batched queries
+/// sorted by region. Each worker thread should use its own cache.
+///
+/// Only up to date occupancy summaries are used - see @c currentOccupancySummary() - as the summaries may not be
+/// updated concurrently. Queries should bring the summaries up to date before starting threaded evaluation.
+class QueryRegionCache
+{
+public:
+  /// Maximum number of regions retained. Enough for a search volume spanning 3x3x3 regions.
+  static constexpr size_t kMaxCachedRegions = 27u;
+
+  /// Constructor.
+  /// @param map The map to fetch regions from.
+  /// @param layer_index The layer to retain buffers for.
+  inline QueryRegionCache(OccupancyMap &map, int layer_index)
+    : map_(map)
+    , layer_index_(layer_index)
+    , summarise_(layer_index == map.layout().occupancyLayer())
+  {
+    regions_.reserve(kMaxCachedRegions);
+  }
+
+  /// Fetch the cached details for @p region_key , retaining the region buffer if not already cached.
+  /// @param region_key The region of interest.
+  /// @return The cached region. Remains valid until the next @c region() call.
+  inline const QueryCachedRegion &region(const glm::i16vec3 &region_key)
+  {
+    for (const auto &region : regions_)
+    {
+      if (region.region_key == region_key)
+      {
+        return region;
+      }
+    }
+
+    if (regions_.size() == kMaxCachedRegions)
+    {
+      regions_.erase(regions_.begin());
+    }
+
+    QueryCachedRegion region;
+    region.region_key = region_key;
+    region.chunk = map_.region(region_key, false);
+    if (region.chunk)
+    {
+      region.buffer = VoxelBuffer<const VoxelBlock>(region.chunk->voxel_blocks[layer_index_]);
+      region.summary = (summarise_) ? currentOccupancySummary(*region.chunk) : nullptr;
+    }
+    regions_.emplace_back(std::move(region));
+    return regions_.back();
+  }
+
+private:
+  OccupancyMap &map_;
+  int layer_index_ = -1;
+  bool summarise_ = false;
+  std::vector<QueryCachedRegion> regions_;
+};
+}  // namespace ohm
+
+#endif  // OHM_QUERYREGIONCACHE_H
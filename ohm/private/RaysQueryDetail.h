@@ -10,12 +10,52 @@
 
 #include "QueryDetail.h"
 
+#include <ohm/MapRegion.h>
 #include <ohm/OccupancyType.h>
+#include <ohm/VoxelOrder.h>
+
+#include <glm/vec3.hpp>
 
 #include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 namespace ohm
 {
+/// Per ray results retained between executions of an incremental @c RaysQuery . See @c RaysQuery::setIncremental() .
+struct RaysQueryCache
+{
+  /// Cached @c QueryDetail::ranges .
+  std::vector<double> ranges;
+  /// Cached @c QueryDetail::intersected_voxels .
+  std::vector<Key> intersected_voxels;
+  /// Cached @c RaysQueryDetail::unobserved_volumes_out .
+  std::vector<double> unobserved_volumes;
+  /// Cached @c RaysQueryDetail::terminal_states_out .
+  std::vector<OccupancyType> terminal_states;
+  /// The regions traversed by each ray, in traversal order.
+  std::vector<std::vector<glm::i16vec3>> ray_regions;
+  /// The @c MapChunk::dirty_stamp of each traversed region when the cached results were calculated. Zero for regions
+  /// which did not exist.
+  std::unordered_map<glm::i16vec3, uint64_t, MapRegion::Hash> region_stamps;
+
+  /// Query the number of rays with cached results. These are always the leading rays.
+  /// @return The number of cached rays.
+  inline size_t size() const { return ranges.size(); }
+
+  /// Clear all cached results.
+  inline void clear()
+  {
+    ranges.clear();
+    intersected_voxels.clear();
+    unobserved_volumes.clear();
+    terminal_states.clear();
+    ray_regions.clear();
+    region_stamps.clear();
+  }
+};
+
 struct ohm_API RaysQueryDetail : QueryDetail
 {
   /// Set of origin/end point pairs to lookup in the map.
@@ -25,7 +65,14 @@ struct ohm_API RaysQueryDetail : QueryDetail
   double volume_coefficient = 1.0f;
   int occupancy_layer = -1;              ///< Cached occupancy layer index.
   glm::u8vec3 occupancy_dim{ 0, 0, 0 };  ///< Cached occupancy layer voxel dimensions. Voxel mean must exactly match.
+  VoxelOrder occupancy_order = VoxelOrder::kRowMajor;  ///< Cached occupancy layer voxel order.
   bool valid_layers = false;             ///< Has layer validation passed?
+  /// Retain results between executions, re-evaluating only rays traversing modified regions?
+  bool incremental = false;
+  /// Results retained for an @c incremental query.
+  RaysQueryCache cache;
+  /// Number of rays walked by the last execution.
+  size_t evaluated_ray_count = 0;
 };
 }  // namespace ohm
 
@@ -0,0 +1,58 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONCHANGEFEEDDETAIL_H
+#define OHM_REGIONCHANGEFEEDDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "ohm/MapRegion.h"
+#include "ohm/Mutex.h"
+
+#include <glm/vec3.hpp>
+
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+namespace ohm
+{
+struct OccupancyMapDetail;
+
+/// Internal details of a @c RegionChangeFeed . Registered with the @c OccupancyMapDetail::change_feeds .
+struct ohm_API RegionChangeFeedDetail
+{
+  /// The map subscribed to. Cleared under the @c OccupancyMapDetail::change_feed_mutex if the map is destroyed first.
+  OccupancyMapDetail *map = nullptr;
+  /// Region keys changed since the last drain, in notification order.
+  std::vector<glm::i16vec3> pending;
+  /// Set of @c pending keys used to avoid duplicate entries.
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> pending_set;
+  /// Invoked by @c rebase() . See @c RegionChangeFeed::setRebaseCallback() .
+  std::function<void(const glm::dvec3 &)> rebase_callback;
+  /// Number of @c rebase() events received.
+  unsigned rebase_count = 0;
+  /// Protects @c pending , @c pending_set , @c rebase_callback and @c rebase_count .
+  Mutex mutex;
+
+  /// Append @p region_key to the @c pending keys unless already present.
+  /// @param region_key The changed region.
+  void push(const glm::i16vec3 &region_key)
+  {
+    std::unique_lock<Mutex> guard(mutex);
+    if (pending_set.insert(region_key).second)
+    {
+      pending.emplace_back(region_key);
+    }
+  }
+
+  /// Shift the @c pending keys for an @c OccupancyMap::rebaseOrigin() , dropping keys which leave the key range, then
+  /// invoke the @c rebase_callback .
+  /// @param region_shift The region key shift. See @c OccupancyMap::shiftRegionKey() .
+  void rebase(const glm::dvec3 &region_shift);
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONCHANGEFEEDDETAIL_H
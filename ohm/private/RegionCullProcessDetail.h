@@ -0,0 +1,52 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONCULLPROCESSDETAIL_H
+#define OHM_REGIONCULLPROCESSDETAIL_H
+
+#include "OhmConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+namespace ohm
+{
+struct MapChunk;
+
+struct RegionCullProcessDetail
+{
+  /// Snapshot of the region keys for the current sweep.
+  std::vector<glm::i16vec3> sweep_keys;
+  /// Index of the next item in @c sweep_keys to check. The sweep is complete when this reaches the end.
+  size_t sweep_index = 0;
+  /// Region keys marked for removal in the current update.
+  std::vector<glm::i16vec3> marked_keys;
+  /// Chunks removed from the map, awaiting deferred release.
+  std::vector<MapChunk *> detached;
+  /// Total number of regions removed.
+  size_t removed_count = 0;
+  /// Regions touched before this time are expired. Only used when @c expiry_enabled .
+  double expiry_time = 0;
+  /// Time to evaluate region decay at. Only used when @c decay_enabled .
+  double decay_time = 0;
+  /// Decayed voxel probability limit. See @c RegionCullProcess::setDecayCullProbability() .
+  float decay_probability = 0.52f;  // NOLINT(readability-magic-numbers)
+  /// Cull distance from the reference position. Disabled when <= 0.
+  double cull_distance = 0;
+  /// Cull box minimum extents. Only used when @c extents_enabled .
+  glm::dvec3 cull_min_extents{ 0.0 };
+  /// Cull box maximum extents. Only used when @c extents_enabled .
+  glm::dvec3 cull_max_extents{ 0.0 };
+  /// Is expiry enabled?
+  bool expiry_enabled = false;
+  /// Is culling by extents enabled?
+  bool extents_enabled = false;
+  /// Is culling of decayed regions enabled?
+  bool decay_enabled = false;
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONCULLPROCESSDETAIL_H
@@ -0,0 +1,277 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RegionPager.h"
+
+#include "OccupancyMapDetail.h"
+
+#include "ohm/MapChunk.h"
+#include "ohm/MapLayer.h"
+#include "ohm/VoxelBlock.h"
+#include "ohm/VoxelBuffer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace ohm
+{
+// Out of class definitions for ODR use under C++14.
+constexpr unsigned RegionPager::kWriteBuffers;
+constexpr size_t RegionPager::kNoSlot;
+
+
+RegionPager::RegionPager() = default;
+
+
+RegionPager::~RegionPager()
+{
+  close();
+}
+
+
+bool RegionPager::open(const std::string &path, const OccupancyMapDetail &detail)
+{
+  close();
+
+  std::unique_lock<std::mutex> guard(lock_);
+  slot_size_ = 0;
+  for (size_t i = 0; i < detail.layout.layerCount(); ++i)
+  {
+    // Group members are paged with the group layer.
+    if (!detail.layout.layer(i).isGroupMember())
+    {
+      slot_size_ += detail.layout.layer(i).layerByteSize(detail.region_voxel_dimensions);
+    }
+  }
+
+  // One buffer per write in flight plus one to page in.
+  if (!file_.open(path, kAfRead | kAfWrite | kAfTruncate, kWriteBuffers + 1u, std::max<size_t>(slot_size_, 1u)))
+  {
+    return false;
+  }
+
+  path_ = path;
+  buffer_slots_.assign(kWriteBuffers, kNoSlot);
+  next_buffer_ = 0;
+  return true;
+}
+
+
+void RegionPager::close()
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  paged_.clear();
+  free_slots_.clear();
+  slot_count_ = 0;
+  buffer_slots_.clear();
+  if (file_.isOpen())
+  {
+    file_.close();
+    std::remove(path_.c_str());
+  }
+  path_.clear();
+}
+
+
+void RegionPager::clear()
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  // Any region held in a write buffer is forgotten too.
+  file_.waitAll();
+  std::fill(buffer_slots_.begin(), buffer_slots_.end(), kNoSlot);
+  paged_.clear();
+  free_slots_.clear();
+  for (size_t i = 0; i < slot_count_; ++i)
+  {
+    free_slots_.emplace_back(i);
+  }
+}
+
+
+size_t RegionPager::pagedOutCount() const
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  return paged_.size();
+}
+
+
+bool RegionPager::isPagedOut(const glm::i16vec3 &region_key) const
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  return paged_.find(region_key) != paged_.end();
+}
+
+
+bool RegionPager::pageOut(const MapChunk &chunk, const OccupancyMapDetail &detail)
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  if (!file_.isOpen())
+  {
+    return false;
+  }
+
+  // Reuse the least recently submitted write buffer.
+  const unsigned buffer_index = next_buffer_;
+  if (!completeWrite(buffer_index))
+  {
+    return false;
+  }
+
+  PagedRegion paged;
+  paged.region = chunk.region;
+  paged.touched_time = chunk.touched_time;
+  paged.dirty_stamp = chunk.dirty_stamp;
+  paged.first_valid_index = chunk.first_valid_index;
+  paged.flags = chunk.flags;
+  paged.touched_stamps.resize(detail.layout.layerCount());
+
+  if (!free_slots_.empty())
+  {
+    paged.slot = free_slots_.back();
+  }
+  else
+  {
+    paged.slot = slot_count_;
+  }
+
+  uint8_t *slot_data = file_.buffer(buffer_index);
+  for (size_t i = 0; i < detail.layout.layerCount(); ++i)
+  {
+    const MapLayer &layer = detail.layout.layer(i);
+    paged.touched_stamps[i] = chunk.touched_stamps[i];
+    if (layer.isGroupMember())
+    {
+      continue;
+    }
+    VoxelBuffer<const VoxelBlock> voxel_buffer(chunk.voxel_blocks[i]);
+    const size_t layer_bytes = layer.layerByteSize(detail.region_voxel_dimensions);
+    std::memcpy(slot_data, voxel_buffer.voxelMemory(), layer_bytes);
+    slot_data += layer_bytes;
+  }
+
+  if (!file_.submitWrite(buffer_index, slot_size_, uint64_t(paged.slot) * slot_size_))
+  {
+    return false;
+  }
+  buffer_slots_[buffer_index] = paged.slot;
+  next_buffer_ = (next_buffer_ + 1u) % kWriteBuffers;
+
+  if (!free_slots_.empty())
+  {
+    free_slots_.pop_back();
+  }
+  else
+  {
+    ++slot_count_;
+  }
+
+  paged_.emplace(chunk.region.coord, std::move(paged));
+  return true;
+}
+
+
+MapChunk *RegionPager::pageIn(const glm::i16vec3 &region_key, OccupancyMapDetail &detail, bool &paged_out)
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  const auto iter = paged_.find(region_key);
+  paged_out = iter != paged_.end();
+  if (!paged_out)
+  {
+    // Not paged out, or paged in by another thread while we waited for the lock.
+    return nullptr;
+  }
+
+  const PagedRegion &paged = iter->second;
+  auto *chunk = new MapChunk(paged.region, detail);
+  chunk->touched_time = paged.touched_time;
+  chunk->dirty_stamp = paged.dirty_stamp;
+  chunk->first_valid_index = paged.first_valid_index;
+  chunk->flags = paged.flags;
+  chunk->access_stamp = epoch();
+
+  // Copy from the write buffer if the region is still held there, otherwise read from the file.
+  const uint8_t *slot_data = nullptr;
+  for (unsigned i = 0; i < kWriteBuffers; ++i)
+  {
+    if (buffer_slots_[i] == paged.slot)
+    {
+      // Complete the write so the slot may be reused. The result is irrelevant as the buffer holds the region.
+      file_.wait(i);
+      buffer_slots_[i] = kNoSlot;
+      slot_data = file_.buffer(i);
+      break;
+    }
+  }
+
+  if (!slot_data)
+  {
+    const unsigned read_buffer = kWriteBuffers;
+    if (!file_.submitRead(read_buffer, slot_size_, uint64_t(paged.slot) * slot_size_) ||
+        file_.wait(read_buffer) != std::ptrdiff_t(slot_size_))
+    {
+      // Leave the region paged out so we may try again.
+      delete chunk;
+      return nullptr;
+    }
+    slot_data = file_.buffer(read_buffer);
+  }
+
+  for (size_t i = 0; i < detail.layout.layerCount(); ++i)
+  {
+    const MapLayer &layer = detail.layout.layer(i);
+    chunk->touched_stamps[i] = paged.touched_stamps[i];
+    if (layer.isGroupMember())
+    {
+      continue;
+    }
+    VoxelBuffer<VoxelBlock> voxel_buffer(chunk->voxel_blocks[i]);
+    const size_t layer_bytes = layer.layerByteSize(detail.region_voxel_dimensions);
+    std::memcpy(voxel_buffer.voxelMemory(), slot_data, layer_bytes);
+    slot_data += layer_bytes;
+  }
+
+  // Publish the chunk before releasing the lock so other threads requesting the same region find the chunk in the map.
+  // The region cannot already be in the map as regions are only created when not paged out.
+  detail.chunks.insert(chunk->region.coord, chunk);
+  free_slots_.emplace_back(paged.slot);
+  paged_.erase(iter);
+  return chunk;
+}
+
+
+bool RegionPager::completeWrite(unsigned buffer_index)
+{
+  const size_t slot = buffer_slots_[buffer_index];
+  if (slot == kNoSlot)
+  {
+    return true;
+  }
+
+  // The write is not pending only if it failed previously.
+  if (!file_.pending(buffer_index) || file_.wait(buffer_index) < 0)
+  {
+    // Retry as the buffer holds the only copy of the region.
+    if (!file_.submitWrite(buffer_index, slot_size_, uint64_t(slot) * slot_size_) || file_.wait(buffer_index) < 0)
+    {
+      return false;
+    }
+  }
+
+  buffer_slots_[buffer_index] = kNoSlot;
+  return true;
+}
+
+
+void RegionPager::pagedOutKeys(std::vector<glm::i16vec3> &keys) const
+{
+  std::unique_lock<std::mutex> guard(lock_);
+  keys.reserve(keys.size() + paged_.size());
+  for (const auto &paged : paged_)
+  {
+    keys.emplace_back(paged.first);
+  }
+}
+}  // namespace ohm
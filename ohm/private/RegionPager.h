@@ -0,0 +1,156 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONPAGER_H
+#define OHM_REGIONPAGER_H
+
+#include "OhmConfig.h"
+
+#include "AsyncFile.h"
+
+#include "ohm/MapRegion.h"
+
+#include <glm/vec3.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+struct MapChunk;
+struct OccupancyMapDetail;
+
+/// Backing store for @c OccupancyMap regions paged out of memory - see @c OccupancyMap::enableRegionPaging() .
+///
+/// Paged out regions are written raw to fixed size slots in a single backing file. Each slot holds the voxel memory
+/// for every layer of one region, including layers flagged @c MapLayer::kSkipSerialise , while the remaining
+/// @c MapChunk state is held in memory. Slots are reused once a region is paged back in so the file size is bounded by
+/// the maximum number of regions paged out at once.
+///
+/// Page out is write behind: each region is copied to one of @c kWriteBuffers @c AsyncFile buffers and written while
+/// later regions are copied, so several writes are in flight at once. A region remains in its buffer until the write
+/// completes, so paging in a region still being written copies from the buffer. A failed write is retried before its
+/// buffer is reused and the buffer is held until the write succeeds.
+///
+/// Regions are paged out by @c OccupancyMap::updateRegionPaging() , which requires exclusive access to the map. Paging
+/// in is thread safe and occurs on demand from @c OccupancyMap::region() . This class also tracks the paging
+/// @c epoch() , which is used to track the least recently used regions via @c MapChunk::access_stamp .
+class RegionPager
+{
+public:
+  /// Number of buffers used to keep page out writes in flight.
+  static constexpr unsigned kWriteBuffers = 4u;
+
+  /// Constructor.
+  RegionPager();
+  /// Destructor. Closes and removes the backing file.
+  ~RegionPager();
+
+  /// Create the backing file at @p path . Any existing file is truncated.
+  /// @param path The backing file path.
+  /// @param detail The map to page regions for. Used to calculate the slot size.
+  /// @return True on success.
+  bool open(const std::string &path, const OccupancyMapDetail &detail);
+
+  /// Close and remove the backing file, forgetting any paged out regions.
+  void close();
+
+  /// Forget all paged out regions, releasing all slots. The backing file remains open.
+  void clear();
+
+  /// Query the backing file path.
+  /// @return The backing file path.
+  inline const std::string &path() const { return path_; }
+
+  /// Query the byte size of a backing file slot, which is also the uncompressed memory size of a region.
+  /// @return The slot byte size.
+  inline size_t slotSize() const { return slot_size_; }
+
+  /// Query the resident memory budget (bytes).
+  uint64_t residentBudget() const { return resident_budget_; }
+  /// Set the resident memory budget (bytes).
+  /// @param budget The new budget.
+  void setResidentBudget(uint64_t budget) { resident_budget_ = budget; }
+
+  /// Query the radius around the hot spot within which regions are never paged out.
+  /// @return The hot radius.
+  double hotRadius() const { return hot_radius_; }
+  /// Set the @c hotRadius() .
+  /// @param radius The new radius.
+  void setHotRadius(double radius) { hot_radius_ = radius; }
+
+  /// Query the current paging epoch.
+  /// @return The current epoch.
+  inline uint64_t epoch() const { return epoch_.load(std::memory_order_relaxed); }
+  /// Advance the paging epoch.
+  /// @return The new epoch.
+  inline uint64_t nextEpoch() { return ++epoch_; }
+
+  /// Query the number of regions currently paged out.
+  /// @return The paged out region count.
+  size_t pagedOutCount() const;
+
+  /// Check if the region at @p region_key is paged out.
+  /// @param region_key The region of interest.
+  /// @return True if the region is paged out.
+  bool isPagedOut(const glm::i16vec3 &region_key) const;
+
+  /// Write @p chunk to the backing store. The caller then removes the chunk from the map.
+  /// @param chunk The chunk to page out.
+  /// @param detail The owning map detail.
+  /// @return True on success. The chunk must remain in the map on failure.
+  bool pageOut(const MapChunk &chunk, const OccupancyMapDetail &detail);
+
+  /// Page in the region at @p region_key if paged out, inserting it into @p detail.chunks . This is thread safe.
+  /// @param region_key The region to page in.
+  /// @param detail The owning map detail.
+  /// @param[out] paged_out Set to true if the region was paged out, even if page in fails.
+  /// @return The paged in chunk or null if not paged out or on failure to read.
+  MapChunk *pageIn(const glm::i16vec3 &region_key, OccupancyMapDetail &detail, bool &paged_out);
+
+  /// Enumerate the keys of all paged out regions.
+  /// @param[out] keys Populated with the paged out region keys.
+  void pagedOutKeys(std::vector<glm::i16vec3> &keys) const;
+
+private:
+  /// Marks a write buffer which does not hold a region.
+  static constexpr size_t kNoSlot = ~size_t(0u);
+
+  /// Complete the write from a write buffer, retrying a failed write, so the buffer may be reused.
+  /// @param buffer_index The write buffer index.
+  /// @return True if the buffer is free, false if the write has failed and the buffer must be held.
+  bool completeWrite(unsigned buffer_index);
+
+  /// In memory details of a paged out region.
+  struct PagedRegion
+  {
+    MapRegion region;                     ///< @c MapChunk::region
+    double touched_time = 0;              ///< @c MapChunk::touched_time
+    uint64_t dirty_stamp = 0;             ///< @c MapChunk::dirty_stamp
+    unsigned first_valid_index = ~0u;     ///< @c MapChunk::first_valid_index
+    unsigned flags = 0;                   ///< @c MapChunk::flags
+    std::vector<uint64_t> touched_stamps; ///< @c MapChunk::touched_stamps
+    size_t slot = 0;                      ///< Backing file slot index.
+  };
+
+  mutable std::mutex lock_;  ///< Guards the backing file and paged region map.
+  AsyncFile file_;           ///< The backing file. The last buffer is used for page in.
+  std::string path_;         ///< Backing file path.
+  size_t slot_size_ = 0;     ///< Bytes per slot.
+  size_t slot_count_ = 0;    ///< Number of slots in the backing file.
+  std::vector<size_t> free_slots_;  ///< Released slots available for reuse.
+  std::vector<size_t> buffer_slots_;  ///< Slot being written from each write buffer or @c kNoSlot .
+  unsigned next_buffer_ = 0;        ///< Next write buffer to use.
+  std::unordered_map<glm::i16vec3, PagedRegion, MapRegion::Hash> paged_;  ///< Paged out regions.
+  uint64_t resident_budget_ = 0;    ///< Resident region memory budget (bytes).
+  double hot_radius_ = 0;           ///< Radius about the hot spot excluded from paging.
+  std::atomic_uint64_t epoch_{ 1 };  ///< Paging epoch.
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONPAGER_H
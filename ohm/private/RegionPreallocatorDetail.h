@@ -0,0 +1,61 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_REGIONPREALLOCATORDETAIL_H
+#define OHM_REGIONPREALLOCATORDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "ohm/Aabb.h"
+
+#include <glm/vec3.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// A queued @c RegionPreallocator request.
+struct RegionPreallocateRequest
+{
+  /// Box to preallocate. Only used when the @c path is empty.
+  Aabb extents{ 0.0 };
+  /// Path to preallocate along.
+  std::vector<glm::dvec3> path;
+  /// Distance from the @c path to preallocate.
+  double radius = 0;
+};
+
+/// Private data for @c RegionPreallocator .
+struct RegionPreallocatorDetail
+{
+  /// The target map.
+  OccupancyMap *map = nullptr;
+  /// Requests waiting for the @c worker_thread .
+  std::deque<RegionPreallocateRequest> queue;
+  /// Guards @c queue , @c busy and @c quit_flag .
+  mutable std::mutex queue_lock;
+  /// Notified when a request is queued or on @c quit_flag .
+  std::condition_variable queue_notify;
+  /// Notified when the @c worker_thread becomes idle with an empty @c queue .
+  std::condition_variable idle_notify;
+  /// Background thread processing the @c queue .
+  std::thread worker_thread;
+  /// Set while the @c worker_thread is processing a request.
+  bool busy = false;
+  /// Set to stop the @c worker_thread .
+  bool quit_flag = false;
+  /// Total number of regions preallocated.
+  std::atomic<size_t> preallocated_count{ 0 };
+};
+}  // namespace ohm
+
+#endif  // OHM_REGIONPREALLOCATORDETAIL_H
@@ -0,0 +1,140 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_ROLLINGWINDOW_H
+#define OHM_ROLLINGWINDOW_H
+
+#include "OhmConfig.h"
+
+#include "ohm/Mutex.h"
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace ohm
+{
+struct MapChunk;
+
+/// Ring buffer region store backing the @c OccupancyMap rolling window mode.
+///
+/// The window covers a fixed box of @c dimensions() regions starting at @c minKey() . Each region key inside the
+/// window maps to a unique @c Slot by wrapping the key on each axis, so a region which leaves the window shares its
+/// slot with the region which enters on the opposite side. A slot holds either the active chunk for its region, or a
+/// @c Slot::spare chunk which has left the window and awaits recycling by the next region created in that slot.
+///
+/// Regions created outside the window are tracked in @c outsideKeys() so they can be culled on the next window move
+/// without scanning the map.
+///
+/// Slot access is serialised by @c mutex() . The @c RollingWindow does not own any chunks; see @c releaseSpares() .
+class RollingWindow
+{
+public:
+  /// A ring buffer slot.
+  struct Slot
+  {
+    /// The chunk in this slot, if any.
+    MapChunk *chunk = nullptr;
+    /// True when @c chunk has been removed from the map and is available for recycling.
+    bool spare = false;
+  };
+
+  /// Constructor.
+  /// @param dimensions The window dimensions in regions. Each axis must be positive.
+  /// @param min_key The initial window minimum region key.
+  inline RollingWindow(const glm::ivec3 &dimensions, const glm::i16vec3 &min_key)
+    : dimensions_(dimensions)
+    , min_key_(min_key)
+    , slots_(size_t(dimensions.x) * size_t(dimensions.y) * size_t(dimensions.z))
+  {}
+
+  /// Query the window dimensions in regions.
+  /// @return The window dimensions.
+  inline const glm::ivec3 &dimensions() const { return dimensions_; }
+  /// Query the minimum region key in the window.
+  /// @return The minimum region key.
+  inline const glm::i16vec3 &minKey() const { return min_key_; }
+  /// Set the minimum region key in the window. Does not update the slots.
+  /// @param min_key The new minimum key.
+  inline void setMinKey(const glm::i16vec3 &min_key) { min_key_ = min_key; }
+
+  /// Check if @p region_key lies within the window.
+  /// @param region_key The key to test.
+  /// @return True if @p region_key is inside the window.
+  inline bool contains(const glm::i16vec3 &region_key) const
+  {
+    const glm::ivec3 offset = glm::ivec3(region_key) - glm::ivec3(min_key_);
+    return offset.x >= 0 && offset.y >= 0 && offset.z >= 0 && offset.x < dimensions_.x &&
+           offset.y < dimensions_.y && offset.z < dimensions_.z;
+  }
+
+  /// Resolve the slot for @p region_key . There is a unique slot for each key within the window.
+  /// @param region_key The region key.
+  /// @return The slot for @p region_key .
+  inline Slot &slot(const glm::i16vec3 &region_key)
+  {
+    const glm::ivec3 index = wrap(glm::ivec3(region_key));
+    return slots_[size_t(index.x) + size_t(index.y) * size_t(dimensions_.x) +
+                  size_t(index.z) * size_t(dimensions_.x) * size_t(dimensions_.y)];
+  }
+
+  /// Access all slots.
+  /// @return The slot array.
+  inline std::vector<Slot> &slots() { return slots_; }
+
+  /// Access the keys of the regions created outside the window since the last window move.
+  /// @return The outside region keys. May contain duplicates.
+  inline std::vector<glm::i16vec3> &outsideKeys() { return outside_keys_; }
+
+  /// Access the mutex used to serialise slot access.
+  /// @return The slot mutex.
+  inline Mutex &mutex() { return mutex_; }
+
+  /// Release all spare chunks by calling @p release_chunk then clear their slots. Active chunks are left untouched.
+  /// @param release_chunk Function called to release each spare chunk: `void(MapChunk *)`.
+  template <typename ReleaseFunc>
+  inline void releaseSpares(ReleaseFunc &&release_chunk)
+  {
+    for (Slot &slot : slots_)
+    {
+      if (slot.chunk && slot.spare)
+      {
+        release_chunk(slot.chunk);
+        slot = Slot{};
+      }
+    }
+  }
+
+  /// Release all spare chunks and forget all active chunks and outside keys. Used when the map releases all of its
+  /// chunks.
+  /// @param release_chunk Function called to release each spare chunk: `void(MapChunk *)`.
+  template <typename ReleaseFunc>
+  inline void clear(ReleaseFunc &&release_chunk)
+  {
+    releaseSpares(release_chunk);
+    std::fill(slots_.begin(), slots_.end(), Slot{});
+    outside_keys_.clear();
+  }
+
+private:
+  inline glm::ivec3 wrap(const glm::ivec3 &key) const
+  {
+    glm::ivec3 index = key % dimensions_;
+    index.x += (index.x < 0) ? dimensions_.x : 0;
+    index.y += (index.y < 0) ? dimensions_.y : 0;
+    index.z += (index.z < 0) ? dimensions_.z : 0;
+    return index;
+  }
+
+  glm::ivec3 dimensions_;
+  glm::i16vec3 min_key_;
+  std::vector<Slot> slots_;
+  std::vector<glm::i16vec3> outside_keys_;
+  Mutex mutex_;
+};
+}  // namespace ohm
+
+#endif  // OHM_ROLLINGWINDOW_H
@@ -0,0 +1,81 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_SHARDEDMAPDETAIL_H
+#define OHM_SHARDEDMAPDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "OccupancyMap.h"
+#include "RayMapperOccupancy.h"
+
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+/// A ray segment clipped to a single shard.
+struct ShardSegment
+{
+  /// Index of the source ray.
+  size_t ray_index;
+  /// Distance from the source ray origin to the segment start.
+  double offset;
+  /// Segment length.
+  double length;
+  /// True if the segment ends at the source ray sample rather than a shard boundary.
+  bool sample_end;
+};
+
+/// Per shard state for @c ShardedMap .
+struct MapShard
+{
+  /// The shard map.
+  std::unique_ptr<OccupancyMap> map;
+  /// Mapper used to integrate rays into the @c map .
+  std::unique_ptr<RayMapperOccupancy> mapper;
+  /// Ray segments clipped to this shard: origin/end point pairs. Rebuilt by each batched operation.
+  std::vector<glm::dvec3> rays;
+  /// Details of each segment in @c rays .
+  std::vector<ShardSegment> segments;
+  /// Per segment intensities, when provided.
+  std::vector<float> intensities;
+  /// Per segment timestamps, when provided.
+  std::vector<double> timestamps;
+  /// @c RaysQuery ranges for each segment.
+  std::vector<double> ranges;
+  /// @c RaysQuery terminating voxel for each segment.
+  std::vector<Key> keys;
+  /// @c RaysQuery terminal occupancy type for each segment.
+  std::vector<OccupancyType> types;
+
+  /// Clear the per operation buffers.
+  inline void clearBatch()
+  {
+    rays.clear();
+    segments.clear();
+    intensities.clear();
+    timestamps.clear();
+    ranges.clear();
+    keys.clear();
+    types.clear();
+  }
+};
+
+/// @c ShardedMap internals.
+struct ShardedMapDetail
+{
+  /// The shards.
+  std::vector<MapShard> shards;
+  /// Region keys at which each shard after the first starts along the @c axis .
+  std::vector<int> boundaries;
+  /// The partition axis.
+  int axis = 0;
+  /// Run shards in parallel?
+  bool use_threads = true;
+};
+}  // namespace ohm
+
+#endif  // OHM_SHARDEDMAPDETAIL_H
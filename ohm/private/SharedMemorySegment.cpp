@@ -0,0 +1,208 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "SharedMemorySegment.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif  // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // NOMINMAX
+#include <windows.h>
+#else  // _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+#include <cerrno>
+
+namespace ohm
+{
+namespace
+{
+std::string platformName(const std::string &name)
+{
+#ifdef _WIN32
+  return (!name.empty() && name[0] == '/') ? name.substr(1) : name;
+#else   // _WIN32
+  return (!name.empty() && name[0] == '/') ? name : "/" + name;
+#endif  // _WIN32
+}
+}  // namespace
+
+
+SharedMemorySegment::~SharedMemorySegment()
+{
+  close();
+}
+
+
+bool SharedMemorySegment::create(const std::string &name, size_t byte_size)
+{
+  close();
+  if (name.empty() || byte_size == 0)
+  {
+    return false;
+  }
+
+  const std::string segment_name = platformName(name);
+#ifdef _WIN32
+  const auto size64 = uint64_t(byte_size);
+  HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size64 >> 32u),
+                                      DWORD(size64 & 0xffffffffu), segment_name.c_str());
+  if (!mapping)
+  {
+    return false;
+  }
+
+  if (GetLastError() == ERROR_ALREADY_EXISTS)
+  {
+    // Page file mappings are removed with the last handle, so an existing mapping is still in use.
+    CloseHandle(mapping);
+    return false;
+  }
+
+  void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, byte_size);
+  if (!view)
+  {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  mapping_handle_ = mapping;
+  data_ = static_cast<uint8_t *>(view);
+#else   // _WIN32
+  const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+  int fd = shm_open(segment_name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+  if (fd < 0 && errno == EEXIST)
+  {
+    // Left over from a publisher which did not shut down cleanly. Readers of the stale segment keep their mapping.
+    shm_unlink(segment_name.c_str());
+    fd = shm_open(segment_name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+  }
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  // ftruncate() zero fills the new segment.
+  if (ftruncate(fd, off_t(byte_size)) != 0)
+  {
+    ::close(fd);
+    shm_unlink(segment_name.c_str());
+    return false;
+  }
+
+  void *mapped = mmap(nullptr, byte_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping remains valid after closing the file descriptor.
+  ::close(fd);
+  if (mapped == MAP_FAILED)  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  {
+    shm_unlink(segment_name.c_str());
+    return false;
+  }
+
+  data_ = static_cast<uint8_t *>(mapped);
+#endif  // _WIN32
+  size_ = byte_size;
+  name_ = segment_name;
+  owner_ = true;
+  return true;
+}
+
+
+bool SharedMemorySegment::open(const std::string &name)
+{
+  close();
+  if (name.empty())
+  {
+    return false;
+  }
+
+  const std::string segment_name = platformName(name);
+#ifdef _WIN32
+  HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, segment_name.c_str());
+  if (!mapping)
+  {
+    return false;
+  }
+
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view)
+  {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  MEMORY_BASIC_INFORMATION info = {};
+  if (!VirtualQuery(view, &info, sizeof(info)))
+  {
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+    return false;
+  }
+
+  mapping_handle_ = mapping;
+  data_ = static_cast<uint8_t *>(view);
+  size_ = size_t(info.RegionSize);
+#else   // _WIN32
+  const int fd = shm_open(segment_name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat segment_stat = {};
+  if (fstat(fd, &segment_stat) != 0 || segment_stat.st_size <= 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  const auto byte_size = size_t(segment_stat.st_size);
+  void *mapped = mmap(nullptr, byte_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+  {
+    return false;
+  }
+
+  data_ = static_cast<uint8_t *>(mapped);
+  size_ = byte_size;
+#endif  // _WIN32
+  name_ = segment_name;
+  owner_ = false;
+  return true;
+}
+
+
+void SharedMemorySegment::close()
+{
+  if (!data_)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  UnmapViewOfFile(data_);
+  CloseHandle(mapping_handle_);
+  mapping_handle_ = nullptr;
+#else   // _WIN32
+  munmap(data_, size_);
+  if (owner_)
+  {
+    shm_unlink(name_.c_str());
+  }
+#endif  // _WIN32
+  data_ = nullptr;
+  size_ = 0;
+  name_.clear();
+  owner_ = false;
+}
+}  // namespace ohm
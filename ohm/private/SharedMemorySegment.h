@@ -0,0 +1,74 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_SHAREDMEMORYSEGMENT_H
+#define OHM_SHAREDMEMORYSEGMENT_H
+
+#include "OhmConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ohm
+{
+/// A minimal named shared memory segment. Uses POSIX shared memory, or a named page file mapping on Windows.
+///
+/// The creator maps the segment read/write and removes the name on @c close() . Other processes @c open() the segment
+/// read only. Existing mappings remain valid after the name is removed.
+class SharedMemorySegment
+{
+public:
+  /// Constructor: nothing mapped.
+  SharedMemorySegment() = default;
+  /// Destructor: unmaps the segment.
+  ~SharedMemorySegment();
+
+  SharedMemorySegment(const SharedMemorySegment &) = delete;
+  SharedMemorySegment &operator=(const SharedMemorySegment &) = delete;
+
+  /// Create and map a zero initialised segment for reading and writing. Any currently mapped segment is closed first.
+  /// A stale segment of the same name, left by a process which did not close it, is replaced.
+  /// @param name The segment name. A leading '/' is added for POSIX when missing.
+  /// @param byte_size The segment size in bytes.
+  /// @return True on success.
+  bool create(const std::string &name, size_t byte_size);
+
+  /// Open and map an existing segment read only. Any currently mapped segment is closed first.
+  /// @param name The segment name, as passed to @c create() .
+  /// @return True on success.
+  bool open(const std::string &name);
+
+  /// Unmap the current segment, removing the segment name if this object created it.
+  void close();
+
+  /// Check if a segment is mapped.
+  /// @return True when mapped.
+  inline bool isOpen() const { return data_ != nullptr; }
+
+  /// Check if the segment was created by this object, and is writable.
+  /// @return True when the creator.
+  inline bool isOwner() const { return owner_; }
+
+  /// Access the mapped segment. Only writable when @c isOwner() .
+  /// @return The mapped memory or null when not open.
+  inline uint8_t *data() const { return data_; }
+
+  /// Query the mapped byte size.
+  /// @return The segment size in bytes.
+  inline size_t size() const { return size_; }
+
+private:
+  uint8_t *data_ = nullptr;  ///< Mapped segment.
+  size_t size_ = 0;          ///< Mapped byte size.
+  std::string name_;         ///< Platform segment name.
+  bool owner_ = false;       ///< Created by this object?
+#ifdef _WIN32
+  void *mapping_handle_ = nullptr;  ///< Win32 file mapping handle.
+#endif                              // _WIN32
+};
+}  // namespace ohm
+
+#endif  // OHM_SHAREDMEMORYSEGMENT_H
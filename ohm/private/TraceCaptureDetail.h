@@ -0,0 +1,43 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_TRACECAPTUREDETAIL_H
+#define OHM_TRACECAPTUREDETAIL_H
+
+#include "OhmConfig.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ohm
+{
+/// Private data for @c TraceCaptureWriter .
+struct TraceCaptureWriterDetail
+{
+  /// The capture file.
+  std::ofstream out;
+  /// Serialised batches waiting for the @c writer_thread .
+  std::deque<std::vector<uint8_t>> queue;
+  /// Guards @c queue and @c quit_flag .
+  std::mutex queue_lock;
+  /// Notified when a batch is queued or on @c quit_flag .
+  std::condition_variable queue_notify;
+  /// Background thread writing the @c queue to @c out .
+  std::thread writer_thread;
+  /// Set to stop the @c writer_thread once the @c queue is empty.
+  bool quit_flag = false;
+  /// Set if any write fails.
+  std::atomic_bool failed{ false };
+  /// Write rays with each batch?
+  bool with_rays = false;
+};
+}  // namespace ohm
+
+#endif  // OHM_TRACECAPTUREDETAIL_H
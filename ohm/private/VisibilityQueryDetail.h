@@ -0,0 +1,34 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VISIBILITYQUERYDETAIL_H
+#define OHM_VISIBILITYQUERYDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "QueryDetail.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+/// Pimpl data for @c VisibilityQuery
+struct ohm_API VisibilityQueryDetail : QueryDetail
+{
+  std::vector<glm::dvec3> sources;  ///< Source points: the visibility matrix rows.
+  std::vector<glm::dvec3> targets;  ///< Target points: the visibility matrix columns.
+  /// Set when the @c sources and @c targets are the same point set, so only one segment is walked for each pair.
+  bool symmetric = false;
+  /// Visibility bit matrix results. See @c VisibilityQuery::visibility() .
+  std::vector<uint64_t> visibility;
+  /// Number of words in each row of @c visibility .
+  size_t row_words = 0;
+};
+}  // namespace ohm
+
+#endif  // OHM_VISIBILITYQUERYDETAIL_H
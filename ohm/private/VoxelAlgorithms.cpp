@@ -6,7 +6,9 @@
 #include "VoxelAlgorithms.h"
 
 #include "Key.h"
+#include "MapChunk.h"
 #include "OccupancyMap.h"
+#include "OccupancySummary.h"
 #include "VoxelData.h"
 
 #include <limits>
@@ -56,6 +58,19 @@ float calculateNearestNeighbour(const Key &voxel_key, const OccupancyMap &map,
         map.moveKey(search_key, x, y, z);
         test_voxel.setKey(search_key);
 
+        // Skip voxels in bricks which cannot be occupied. Only use up to date summaries as this may be threaded.
+        const RegionOccupancySummary *summary =
+          (test_voxel.chunk()) ? currentOccupancySummary(*test_voxel.chunk()) : nullptr;
+        const int empty_run =
+          (summary) ? summary->emptyRunLength(glm::ivec3(search_key.localKey()), map.occupancyThresholdValue(),
+                                              unobserved_as_occupied) :
+                      0;
+        if (empty_run > 0)
+        {
+          x += empty_run - 1;
+          continue;
+        }
+
         if (ignore_self && x == 0 && y == 0 && z == 0)
         {
           continue;
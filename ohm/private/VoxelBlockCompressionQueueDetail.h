@@ -9,6 +9,7 @@
 #include "OhmConfig.h"
 
 #include "Mutex.h"
+#include "VoxelBlockCompressionQueue.h"
 
 #ifdef OHM_FEATURE_THREADS
 #include <tbb/concurrent_queue.h>
@@ -17,6 +18,7 @@
 #endif  // OHM_FEATURE_THREADS
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
@@ -32,6 +34,45 @@ struct CompressionEntry
 {
   VoxelBlock *voxels;      ///< [Compression enabled] voxel block.
   size_t allocation_size;  ///< Last calculated allocation size.
+  /// Compression priority from the @c VoxelBlockCompressionQueue::PriorityFunction . Higher compresses first.
+  double priority = 0;
+  /// Time at which the queue last compressed the block. Valid when @c queue_compressed is set.
+  std::chrono::steady_clock::time_point compressed_time;
+  /// Set when the queue compresses the block and cleared once the block is seen uncompressed again.
+  bool queue_compressed = false;
+  /// Cached @c VoxelBlock::kFProtected state for sorting.
+  bool protect = false;
+};
+
+/// Shared state for the @c VoxelBlockCompressionQueue compression workers. A job is a compression pass over a range
+/// of @c VoxelBlockCompressionQueueDetail::blocks which continues until the low tide is reached.
+struct CompressionJob
+{
+  /// Data access mutex.
+  std::mutex lock;
+  /// Notified when a new job starts or the workers should quit.
+  std::condition_variable start_signal;
+  /// Notified when a worker completes its part of a job.
+  std::condition_variable done_signal;
+  /// Incremented for each new job. Workers wait for this to change.
+  unsigned job_id = 0;
+  /// Number of pool workers requested for the current job.
+  unsigned requested_workers = 0;
+  /// Number of pool workers still processing the current job.
+  unsigned busy_workers = 0;
+  /// Set to stop the worker threads.
+  bool quit = false;
+
+  /// Next index into @c VoxelBlockCompressionQueueDetail::blocks to process.
+  std::atomic_size_t cursor{ 0 };
+  /// One past the last index to process.
+  size_t end = 0;
+  /// Memory usage at the start of the job.
+  uint64_t memory_usage = 0;
+  /// Compress until `memory_usage - freed` drops below this value.
+  uint64_t low_tide = 0;
+  /// Number of bytes freed during the job.
+  std::atomic_uint64_t freed{ 0 };
 };
 
 /// @c VoxelBlockCompressionQueue internals.
@@ -43,11 +84,15 @@ struct VoxelBlockCompressionQueueDetail
 #ifdef OHM_FEATURE_THREADS
   /// Queue used to push @c VoxelBlock candidates for compression.
   tbb::concurrent_queue<VoxelBlock *> compression_queue;
+  /// Queue of @c VoxelBlock items to prefetch. Each is flagged @c VoxelBlock::kFPrefetchPending while queued.
+  tbb::concurrent_queue<VoxelBlock *> prefetch_queue;
 #else   // OHM_FEATURE_THREADS
-  /// Mutex for @c compression_queue
+  /// Mutex for @c compression_queue and @c prefetch_queue
   ohm::Mutex queue_lock;
   /// Queue used to push @c VoxelBlock candidates for compression.
   std::queue<VoxelBlock *> compression_queue;
+  /// Queue of @c VoxelBlock items to prefetch. Each is flagged @c VoxelBlock::kFPrefetchPending while queued.
+  std::queue<VoxelBlock *> prefetch_queue;
 #endif  // OHM_FEATURE_THREADS
   /// Full set of registered @c VoxelBlock items.
   std::vector<CompressionEntry> blocks;
@@ -57,10 +102,35 @@ struct VoxelBlockCompressionQueueDetail
   std::atomic_uint64_t low_tide{ 6ull * 1024ull * 1024ull * 1024ull };
   /// Current allocation estimation.
   std::atomic_uint64_t estimated_allocated_size{ 0 };
+  /// Maximum number of threads used to compress blocks, including the management thread.
+  std::atomic_uint worker_count{ 1 };
+  /// Mutex for @c priority_function .
+  ohm::Mutex policy_lock;
+  /// Function used to prioritise blocks for compression. Empty for @c CompressionPolicy::kLargestFirst .
+  VoxelBlockCompressionQueue::PriorityFunction priority_function;
+  /// Blocks decompressed within this many seconds of compression count as thrashing.
+  std::atomic<double> thrash_window{ 5.0 };
+  /// Number of blocks compressed by the queue.
+  std::atomic_uint64_t compressed_count{ 0 };
+  /// Number of queue compressed blocks observed decompressed again.
+  std::atomic_uint64_t decompressed_count{ 0 };
+  /// Number of blocks decompressed within the @c thrash_window of compression.
+  std::atomic_uint64_t thrash_count{ 0 };
+  /// Compression worker threads. Created as required by the @c worker_count. Each worker owns its own compression
+  /// buffer.
+  std::vector<std::thread> workers;
+  /// Compression work shared with the @c workers .
+  CompressionJob job;
   /// Thread reference count.
   std::atomic_int reference_count{ 0 };
   /// Thread quit flag.
   std::atomic_bool quit_flag{ false };
+  /// Set when items are pushed onto the @c prefetch_queue to wake the processing thread.
+  std::atomic_bool prefetch_signalled{ false };
+  /// Mutex for @c wake_signal .
+  std::mutex wake_lock;
+  /// Wakes the processing thread early to service prefetch requests or quit.
+  std::condition_variable wake_signal;
   /// Processing thread.
   std::thread processing_thread;
   /// True if @c processing_thread is running.
@@ -79,6 +149,33 @@ inline void push(VoxelBlockCompressionQueueDetail &detail, VoxelBlock *block)
 #endif  // OHM_FEATURE_THREADS
 }
 
+inline void pushPrefetch(VoxelBlockCompressionQueueDetail &detail, VoxelBlock *block)
+{
+#ifdef OHM_FEATURE_THREADS
+  detail.prefetch_queue.push(block);
+#else   // OHM_FEATURE_THREADS
+  std::unique_lock<ohm::Mutex> guard(detail.queue_lock);
+  detail.prefetch_queue.emplace(block);
+#endif  // OHM_FEATURE_THREADS
+}
+
+inline bool tryPopPrefetch(VoxelBlockCompressionQueueDetail &detail, VoxelBlock **block)
+{
+#ifdef OHM_FEATURE_THREADS
+  return detail.prefetch_queue.try_pop(*block);
+#else   // OHM_FEATURE_THREADS
+  std::unique_lock<ohm::Mutex> guard(detail.queue_lock);
+  if (!detail.prefetch_queue.empty())
+  {
+    *block = detail.prefetch_queue.front();
+    detail.prefetch_queue.pop();
+    return true;
+  }
+
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
 inline bool tryPop(VoxelBlockCompressionQueueDetail &detail, VoxelBlock **block)
 {
 #ifdef OHM_FEATURE_THREADS
@@ -0,0 +1,96 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHM_VOXELRANGECACHEDETAIL_H
+#define OHM_VOXELRANGECACHEDETAIL_H
+
+#include "OhmConfig.h"
+
+#include "ohm/MapRegion.h"
+#include "ohm/Mutex.h"
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// The parameters on which a cached voxel range depends, excluding the voxel itself.
+struct VoxelRangeParams
+{
+  const OccupancyMap *map = nullptr;
+  glm::ivec3 voxel_search_half_extents{ 0 };
+  glm::vec3 axis_scaling{ 1.0f };
+  float search_range = 0;
+  bool unobserved_as_occupied = false;
+  bool ignore_self = false;
+  bool report_unscaled_distance = false;
+
+  inline bool operator==(const VoxelRangeParams &other) const
+  {
+    return map == other.map && voxel_search_half_extents == other.voxel_search_half_extents &&
+           axis_scaling == other.axis_scaling && search_range == other.search_range &&
+           unobserved_as_occupied == other.unobserved_as_occupied && ignore_self == other.ignore_self &&
+           report_unscaled_distance == other.report_unscaled_distance;
+  }
+};
+
+/// Identifies the cached ranges for a region with a particular @c VoxelRangeParams .
+struct VoxelRangeRegionKey
+{
+  glm::i16vec3 region_key{ 0 };
+  VoxelRangeParams params;
+
+  inline bool operator==(const VoxelRangeRegionKey &other) const
+  {
+    return region_key == other.region_key && params == other.params;
+  }
+
+  /// Hash for @c VoxelRangeRegionKey . Only hashes the region key as parameters rarely vary.
+  struct Hash
+  {
+    inline size_t operator()(const VoxelRangeRegionKey &key) const { return MapRegion::Hash()(key.region_key); }
+  };
+};
+
+/// Cached ranges for a region.
+struct VoxelRangeRegion
+{
+  /// Range for each voxel in the region. NaN for voxels not yet calculated.
+  std::vector<float> ranges;
+  /// @c OccupancyMap::stamp() when the @c ranges were last reset. Regions within the search extents with a later
+  /// @c MapChunk::dirty_stamp invalidate the @c ranges .
+  uint64_t cache_stamp = 0;
+  /// @c OccupancyMap::stamp() at which the @c ranges were last validated.
+  uint64_t validated_stamp = 0;
+};
+
+/// Internal details for @c VoxelRangeCache .
+struct VoxelRangeCacheDetail
+{
+  /// Number of independently locked partitions of the cached regions.
+  static constexpr unsigned kStripeCount = 64u;
+
+  /// A partition of the cached regions, selected by region key hash.
+  struct Stripe
+  {
+    Mutex mutex;
+    std::unordered_map<VoxelRangeRegionKey, VoxelRangeRegion, VoxelRangeRegionKey::Hash> regions;
+  };
+
+  std::array<Stripe, kStripeCount> stripes;
+  std::atomic_uint64_t hits{ 0 };
+  std::atomic_uint64_t misses{ 0 };
+  std::atomic_uint64_t invalidations{ 0 };
+};
+}  // namespace ohm
+
+#endif  // OHM_VOXELRANGECACHEDETAIL_H
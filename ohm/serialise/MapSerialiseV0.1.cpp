@@ -108,6 +108,7 @@ int loadLayout(InputStream &stream, OccupancyMapDetail &map)
     ok = read<uint16_t>(stream, subsampling) && ok;
 
     MapLayer *layer = layout.addLayer(layer_name.data(), subsampling);
+    layer->setFlags(layer_flags);
 
     // Read voxel layout.
     VoxelLayout voxel_layout = layer->voxelLayout();
@@ -148,6 +149,9 @@ int loadLayout(InputStream &stream, OccupancyMapDetail &map)
     }
   }
 
+  // Bind any group members to their group layers.
+  layout.resolveLayerGroups();
+
   return (ok) ? 0 : kSeFileReadFailure;
 }
 
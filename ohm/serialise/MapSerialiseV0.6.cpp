@@ -0,0 +1,221 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MapSerialiseV0.6.h"
+
+#include "MapSerialiseV0.1.h"
+#include "MapSerialiseV0.2.h"
+
+#include "private/IndexedMapFile.h"
+#include "private/OccupancyMapDetail.h"
+#include "private/SerialiseUtil.h"
+
+#include "MapChunk.h"
+#include "MapSerialise.h"
+#include "Stream.h"
+#include "TaskArena.h"
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ohm
+{
+namespace v0_6
+{
+int load(const std::string &filename, InputStream &stream, OccupancyMapDetail &detail, SerialiseProgress *progress,
+         const MapVersion & /*version*/, size_t region_count, const CopyChunkFilter &chunk_filter,
+         const CopyLayerFilter &layer_filter, bool defer_unselected)
+{
+  uint64_t index_offset = 0;
+  int err = loadPreamble(filename, stream.tell(), detail, index_offset);
+  if (err)
+  {
+    return err;
+  }
+
+  // Shared ownership for deferred layers.
+  const auto file_ptr = std::make_shared<IndexedMapFile>();
+  IndexedMapFile &file = *file_ptr;
+  err = file.open(filename, index_offset, detail);
+  if (err)
+  {
+    return err;
+  }
+
+  if (file.regionCount() != region_count)
+  {
+    return kSeFileReadFailure;
+  }
+
+  std::vector<bool> load_layers;
+  IndexedMapFile::selectLayers(detail.layout, layer_filter, load_layers);
+
+  // Select regions from the index table. The filter is evaluated serially against a chunk without voxel data.
+  std::vector<size_t> selected_regions;
+  selected_regions.reserve(region_count);
+  if (chunk_filter)
+  {
+    const size_t stored_layer_count = file.storedLayers().size();
+    MapChunk probe;
+    probe.map = &detail;
+    probe.touched_stamps = std::make_unique<std::atomic_uint64_t[]>(detail.layout.layerCount());
+    for (size_t i = 0; i < file.regionCount(); ++i)
+    {
+      const IndexedMapFile::RegionEntry &region_entry = file.region(i);
+      probe.region.coord = region_entry.coord;
+      probe.region.centre = region_entry.centre;
+      probe.touched_time = region_entry.touched_time;
+      uint64_t dirty_stamp = 0;
+      for (size_t l = 0; l < stored_layer_count; ++l)
+      {
+        const uint64_t touched_stamp = file.layer(i, l).touched_stamp;
+        probe.touched_stamps[file.storedLayers()[l]] = touched_stamp;
+        dirty_stamp = std::max(dirty_stamp, touched_stamp);
+      }
+      probe.dirty_stamp = dirty_stamp;
+
+      if (chunk_filter(probe))
+      {
+        selected_regions.emplace_back(i);
+      }
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < file.regionCount(); ++i)
+    {
+      selected_regions.emplace_back(i);
+    }
+  }
+
+  if (progress)
+  {
+    if (!selected_regions.empty())
+    {
+      progress->setTargetProgress(unsigned(selected_regions.size()));
+    }
+    else
+    {
+      progress->setTargetProgress(unsigned(1));
+      progress->incrementProgress();
+    }
+  }
+
+  // Regions are independent, so we can load them concurrently. Progress is serialised.
+  std::atomic_int first_error{ kSeOk };
+  std::mutex progress_lock;
+  const auto load_region = [&](size_t i) {
+    if (first_error != kSeOk || progress && progress->quit())
+    {
+      return;
+    }
+
+    auto *chunk = new MapChunk(detail);
+    const int region_err = file.loadRegion(i, *chunk, detail, &load_layers, defer_unselected);
+    if (region_err)
+    {
+      delete chunk;
+      int expected = kSeOk;
+      first_error.compare_exchange_strong(expected, region_err);
+      return;
+    }
+
+    // Resolve map chunk details.
+    IndexedMapFile::updateFirstValid(*chunk, detail);
+    detail.chunks.insert(chunk->region.coord, chunk);
+
+    if (progress)
+    {
+      std::unique_lock<std::mutex> guard(progress_lock);
+      progress->incrementProgress();
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  parallelExecute([&]() {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0u, selected_regions.size()),
+                      [&load_region, &selected_regions](const tbb::blocked_range<size_t> &range) {
+                        for (size_t i = range.begin(); i < range.end(); ++i)
+                        {
+                          load_region(selected_regions[i]);
+                        }
+                      });
+  });
+#else   // OHM_FEATURE_THREADS
+  for (size_t region_index : selected_regions)
+  {
+    load_region(region_index);
+  }
+#endif  // OHM_FEATURE_THREADS
+
+  return first_error;
+}
+
+
+int open(const std::string &filename, InputStream &stream, OccupancyMapDetail &detail, const MapVersion & /*version*/,
+         size_t region_count, const CopyLayerFilter &eager_layer_filter)
+{
+  uint64_t index_offset = 0;
+  int err = loadPreamble(filename, stream.tell(), detail, index_offset);
+  if (err)
+  {
+    return err;
+  }
+
+  auto file = std::make_shared<IndexedMapFile>();
+  err = file->open(filename, index_offset, detail);
+  if (err)
+  {
+    return err;
+  }
+
+  std::vector<bool> eager_layers;
+  IndexedMapFile::selectLayers(detail.layout, eager_layer_filter, eager_layers);
+  file->setEagerLayers(eager_layers);
+
+  if (file->regionCount() != region_count)
+  {
+    return kSeFileReadFailure;
+  }
+
+  detail.indexed_file = std::move(file);
+  return kSeOk;
+}
+
+
+int loadPreamble(const std::string &filename, size_t header_end, OccupancyMapDetail &detail, uint64_t &index_offset)
+{
+  // The preamble is always uncompressed, so we need a new stream without kSfCompress.
+  InputStream stream(filename);
+  if (!stream.isOpen())
+  {
+    return kSeFileOpenFailure;
+  }
+
+  stream.seek(header_end);
+  index_offset = 0;
+  if (!readRaw<uint64_t>(stream, index_offset))
+  {
+    return kSeFileReadFailure;
+  }
+
+  int err = v0_2::loadMapInfo(stream, detail.info);
+  if (err)
+  {
+    return err;
+  }
+
+  return v0_1::loadLayout(stream, detail);
+}
+}  // namespace v0_6
+}  // namespace ohm
@@ -0,0 +1,69 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef MAPSERIALISEV0_6_H
+#define MAPSERIALISEV0_6_H
+
+#include "OhmConfig.h"
+
+#include "CopyUtil.h"
+
+#include <string>
+
+namespace ohm
+{
+class InputStream;
+struct MapVersion;
+struct OccupancyMapDetail;
+class SerialiseProgress;
+
+/// Version 0.6 is the indexed map format. See @c IndexedMapFile .
+namespace v0_6
+{
+/// Load regions from an indexed map file.
+///
+/// The @p chunk_filter is evaluated against the region index table before loading any voxel data, so rejected
+/// regions are never decoded. The filter is given a chunk with the region, touch time and stamps set, but no voxel
+/// data. The @c MapChunk::dirty_stamp is set to the most recent layer stamp.
+///
+/// @param filename The file being loaded.
+/// @param stream The stream from which the header has been read.
+/// @param detail The map to load into.
+/// @param progress Optional progress tracking.
+/// @param version The loaded header version.
+/// @param region_count The region count loaded from the header.
+/// @param chunk_filter Optional filter selecting the regions to load. All regions are loaded when empty.
+/// @param layer_filter Optional filter selecting the layers to load by name. See @c IndexedMapFile::selectLayers() .
+/// @param defer_unselected Defer loading layers rejected by the @p layer_filter until first accessed, rather than
+///   clearing them. See @c IndexedMapFile::loadRegion() .
+/// @return @c kSeOk on success or a @c SerialisationError code on failure.
+int load(const std::string &filename, InputStream &stream, OccupancyMapDetail &detail, SerialiseProgress *progress,
+         const MapVersion &version, size_t region_count, const CopyChunkFilter &chunk_filter = CopyChunkFilter(),
+         const CopyLayerFilter &layer_filter = CopyLayerFilter(), bool defer_unselected = false);
+
+/// Open an indexed map file, loading the map info and layout and preparing @c OccupancyMapDetail::indexed_file to
+/// load regions on demand.
+/// @param filename The file being loaded.
+/// @param stream The stream from which the header has been read.
+/// @param detail The map to load into.
+/// @param version The loaded header version.
+/// @param region_count The region count loaded from the header.
+/// @param eager_layer_filter Optional filter selecting the layers loaded when a region is paged in. Other layers are
+///   deferred until first accessed. See @c IndexedMapFile::setEagerLayers() .
+/// @return @c kSeOk on success or a @c SerialisationError code on failure.
+int open(const std::string &filename, InputStream &stream, OccupancyMapDetail &detail, const MapVersion &version,
+         size_t region_count, const CopyLayerFilter &eager_layer_filter = CopyLayerFilter());
+
+/// Load the @c MapInfo and @c MapLayout following the header of an indexed map file.
+/// @param filename The file being loaded.
+/// @param header_end The file position immediately after the map header.
+/// @param detail The map to load into.
+/// @param[out] index_offset Set to the region index table file offset.
+/// @return @c kSeOk on success or a @c SerialisationError code on failure.
+int loadPreamble(const std::string &filename, size_t header_end, OccupancyMapDetail &detail, uint64_t &index_offset);
+}  // namespace v0_6
+}  // namespace ohm
+
+#endif  // MAPSERIALISEV0_6_H
@@ -0,0 +1,91 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "BatchTuner.h"
+
+#include <algorithm>
+
+namespace ohmapp
+{
+namespace
+{
+/// Relative throughput drop which reverses the step direction. Avoids reacting to measurement noise.
+const double kThroughputTolerance = 0.02;
+/// Scale applied to the latency bound when cutting the batch size to leave some headroom.
+const double kLatencyHeadroom = 0.9;
+}  // namespace
+
+BatchTuner::BatchTuner(unsigned initial_batch_size, const Settings &settings)
+  : settings_(settings)
+{
+  settings_.max_batch_size = std::max(settings_.max_batch_size, settings_.min_batch_size);
+  batch_size_ = std::max(settings_.min_batch_size, std::min(initial_batch_size, settings_.max_batch_size));
+}
+
+
+bool BatchTuner::addBatch(const DataSource::Stats &stats)
+{
+  const double latency = stats.processTime();
+  if (stats.ray_count == 0 || latency <= 0)
+  {
+    return false;
+  }
+
+  const double seconds_per_ray = latency / double(stats.ray_count);
+  if (seconds_per_ray * batch_size_ > settings_.latency_target)
+  {
+    // Over the latency bound. Cut immediately and search downwards.
+    direction_ = -1;
+    return setBatchSize(kLatencyHeadroom * settings_.latency_target / seconds_per_ray, seconds_per_ray);
+  }
+
+  if (2 * stats.ray_count < batch_size_)
+  {
+    // A short batch that is not representative of the throughput at the current batch size.
+    return false;
+  }
+
+  rays_per_second_total_ += stats.processRaysPerSecond();
+  if (++batch_count_ < std::max(1u, settings_.batches_per_step))
+  {
+    return false;
+  }
+
+  const double rays_per_second = rays_per_second_total_ / double(batch_count_);
+  best_rays_per_second_ = std::max(rays_per_second, best_rays_per_second_);
+  if (last_rays_per_second_ > 0 && rays_per_second < last_rays_per_second_ * (1.0 - kThroughputTolerance))
+  {
+    // The last step reduced throughput. Search in the other direction.
+    direction_ = -direction_;
+  }
+  last_rays_per_second_ = rays_per_second;
+
+  const double step_factor = std::max(settings_.step_factor, 1.0);
+  const double next_size = (direction_ > 0) ? batch_size_ * step_factor : batch_size_ / step_factor;
+  return setBatchSize(next_size, seconds_per_ray);
+}
+
+
+bool BatchTuner::setBatchSize(double batch_size, double seconds_per_ray)
+{
+  // Do not grow beyond the latency bound.
+  batch_size = std::min(batch_size, settings_.latency_target / seconds_per_ray);
+  batch_size = std::max(double(settings_.min_batch_size), std::min(batch_size, double(settings_.max_batch_size)));
+
+  rays_per_second_total_ = 0;
+  batch_count_ = 0;
+
+  const unsigned previous_size = batch_size_;
+  batch_size_ = unsigned(batch_size);
+  if (batch_size_ == previous_size)
+  {
+    // Pinned at a limit. Turn around so the search continues.
+    direction_ = -direction_;
+    last_rays_per_second_ = 0;
+    return false;
+  }
+  return true;
+}
+}  // namespace ohmapp
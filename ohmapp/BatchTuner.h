@@ -0,0 +1,84 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMAPP_BATCHTUNER_H
+#define OHMAPP_BATCHTUNER_H
+
+#include "OhmAppConfig.h"
+
+#include "DataSource.h"
+
+namespace ohmapp
+{
+/// Adapts the batch size online to maximise throughput within a latency bound.
+///
+/// The best batch size depends heavily on the hardware: the GPU grid size for a GpuMap, or the CPU cache and thread
+/// count for a CPU map. The tuner is given the @c DataSource::Stats for each processed batch via @c addBatch() ,
+/// where the process time is the time taken to integrate the batch. It hill climbs on the average rays per second
+/// measured over several batches, stepping the batch size up or down by @c Settings::step_factor and reversing
+/// direction when the throughput drops. The batch size is cut immediately when the projected batch latency exceeds
+/// @c Settings::latency_target .
+///
+/// Batches much smaller than the current batch size - such as those cut short by sensor motion - only contribute to
+/// the latency check.
+class ohmapp_API BatchTuner
+{
+public:
+  /// Tuning parameters.
+  struct ohmapp_API Settings
+  {
+    /// Minimum batch size.
+    unsigned min_batch_size = 1024;
+    /// Maximum batch size.
+    unsigned max_batch_size = 1u << 20u;
+    /// Maximum desired processing time for a batch (seconds).
+    double latency_target = 0.1;
+    /// Multiplicative step size for each batch size change. Must be greater than 1.
+    double step_factor = 1.25;
+    /// Number of batches to average throughput over before each step.
+    unsigned batches_per_step = 4;
+  };
+
+  /// Create a tuner.
+  /// @param initial_batch_size The starting batch size. Clamped to the @p settings limits.
+  /// @param settings Tuning parameters.
+  explicit BatchTuner(unsigned initial_batch_size, const Settings &settings = Settings());
+
+  /// Query the tuning parameters.
+  /// @return The tuning parameters.
+  inline const Settings &settings() const { return settings_; }
+
+  /// Query the current, recommended batch size.
+  /// @return The batch size.
+  inline unsigned batchSize() const { return batch_size_; }
+
+  /// Query the best average throughput measured so far.
+  /// @return The best rays per second measured.
+  inline double bestRaysPerSecond() const { return best_rays_per_second_; }
+
+  /// Add the stats for a processed batch and update the @c batchSize() .
+  /// @param stats Stats for the batch. The process time must cover only the batch processing.
+  /// @return True if the @c batchSize() changed.
+  bool addBatch(const DataSource::Stats &stats);
+
+private:
+  /// Set a new batch size, clamping to the limits and resetting the throughput measurements.
+  /// @return True if the batch size changed.
+  bool setBatchSize(double batch_size, double seconds_per_ray);
+
+  Settings settings_;
+  unsigned batch_size_ = 0;
+  /// Average throughput at the previous batch size. Zero when unknown.
+  double last_rays_per_second_ = 0;
+  double best_rays_per_second_ = 0;
+  /// Total rays per second measured over @c batch_count_ batches.
+  double rays_per_second_total_ = 0;
+  unsigned batch_count_ = 0;
+  /// Direction of the next step: 1 to grow, -1 to shrink.
+  int direction_ = 1;
+};
+}  // namespace ohmapp
+
+#endif  // OHMAPP_BATCHTUNER_H
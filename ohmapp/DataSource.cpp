@@ -8,6 +8,8 @@
 // Must be after argument streaming operators.
 #include <ohmutil/Options.h>
 
+#include <ohm/Metrics.h>
+
 #include <logutil/Logger.h>
 
 using namespace ohm;
@@ -91,6 +93,12 @@ void DataSource::setSamplesOnly(bool samples_only)
 }
 
 
+void DataSource::updateBatchSize(unsigned batch_size)
+{
+  (void)batch_size;
+}
+
+
 int DataSource::validateOptions()
 {
   return 0;
@@ -106,6 +114,13 @@ void DataSource::printConfiguration(std::ostream &out)
 unsigned DataSource::addBatchStats(const Stats &stats, Stats &global_stats, std::vector<Stats> &windowed_stats_buffer,
                                    unsigned windowed_stats_buffer_size, unsigned windowed_stats_buffer_next)
 {
+  static ohm::metrics::Counter &batch_counter =
+    ohm::metrics::Registry::global().counter("ohmapp_batches_total", "Sample batches processed.");
+  static ohm::metrics::Counter &sample_counter =
+    ohm::metrics::Registry::global().counter("ohmapp_samples_total", "Samples processed.");
+  batch_counter.add();
+  sample_counter.add(stats.ray_count);
+
   // Update global stats.
   global_stats.data_time_start = std::min(stats.data_time_start, global_stats.data_time_start);
   global_stats.data_time_end = std::max(stats.data_time_end, global_stats.data_time_end);
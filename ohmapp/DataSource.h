@@ -213,6 +213,15 @@ public:
   /// @param max_sensor_motion Maximum sensor motion for a batch. Zero to disable.
   virtual void requestBatchSettings(unsigned batch_size, double max_sensor_motion) = 0;
 
+  /// Change the target batch size while @c run() is in progress, leaving the sensor motion limit unchanged. Called
+  /// from within the @c BatchFunction , with the new size taking effect from the next batch. Used to tune the batch
+  /// size online - see @c BatchTuner .
+  ///
+  /// The default implementation ignores the request.
+  ///
+  /// @param batch_size Target size for a batch.
+  virtual void updateBatchSize(unsigned batch_size);
+
   /// Configure command line options for this data source.
   /// @param parser Command line parser.
   virtual void configure(cxxopts::Options &parser);
@@ -276,7 +285,8 @@ public:
 
   /// A helper for collating stats.
   ///
-  /// Adds @p stats to the global stats and windowed stats buffer.
+  /// Adds @p stats to the global stats and windowed stats buffer. Also updates the `ohmapp_batches_total` and
+  /// `ohmapp_samples_total` counters in the @c ohm::metrics::Registry::global() .
   ///
   /// @param stats Stats to add.
   /// @param global_stats Global stats to modify.
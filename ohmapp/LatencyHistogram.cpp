@@ -0,0 +1,152 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+
+namespace ohmapp
+{
+namespace
+{
+constexpr double kSecondsPerMicrosecond = 1e-6;
+constexpr unsigned kHalfSubBucketCount = LatencyHistogram::kSubBucketCount / 2;
+
+/// Index of the most significant bit set in @p value . @p value must be non-zero.
+unsigned mostSignificantBit(uint64_t value)
+{
+  unsigned bit = 0;
+  while (value >>= 1u)
+  {
+    ++bit;
+  }
+  return bit;
+}
+}  // namespace
+
+
+void LatencyHistogram::record(double seconds)
+{
+  const auto value = uint64_t(std::max(0.0, std::round(seconds / kSecondsPerMicrosecond)));
+  const size_t index = bucketIndex(value);
+  if (index >= buckets_.size())
+  {
+    buckets_.resize(index + 1, 0);
+  }
+  ++buckets_[index];
+  min_ = (count_) ? std::min(min_, value) : value;
+  max_ = (count_) ? std::max(max_, value) : value;
+  total_ += double(value);
+  ++count_;
+}
+
+
+void LatencyHistogram::reset()
+{
+  buckets_.clear();
+  count_ = min_ = max_ = 0;
+  total_ = 0;
+}
+
+
+double LatencyHistogram::min() const
+{
+  return double(min_) * kSecondsPerMicrosecond;
+}
+
+
+double LatencyHistogram::max() const
+{
+  return double(max_) * kSecondsPerMicrosecond;
+}
+
+
+double LatencyHistogram::mean() const
+{
+  return (count_) ? total_ / double(count_) * kSecondsPerMicrosecond : 0.0;
+}
+
+
+double LatencyHistogram::percentile(double percentile) const
+{
+  if (count_ == 0)
+  {
+    return 0.0;
+  }
+
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  const auto target = std::max<uint64_t>(1u, uint64_t(std::ceil(percentile / 100.0 * double(count_))));
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i)
+  {
+    cumulative += buckets_[i];
+    if (cumulative >= target)
+    {
+      return double(std::min(std::max(bucketHighestValue(i), min_), max_)) * kSecondsPerMicrosecond;
+    }
+  }
+
+  return max();
+}
+
+
+void LatencyHistogram::writeJson(std::ostream &out) const
+{
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::setprecision(9);
+  out << "{ \"count\": " << count_ << ", \"min\": " << min() << ", \"mean\": " << mean()
+      << ", \"p50\": " << percentile(50) << ", \"p90\": " << percentile(90) << ", \"p99\": " << percentile(99)
+      << ", \"p99_9\": " << percentile(99.9) << ", \"p99_99\": " << percentile(99.99) << ", \"max\": " << max()
+      << " }";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+
+void LatencyHistogram::print(std::ostream &out) const
+{
+  const double ms = 1e3;
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::fixed << std::setprecision(3);
+  out << "count " << count_ << " mean " << mean() * ms << "ms p50 " << percentile(50) * ms << "ms p99 "
+      << percentile(99) * ms << "ms p99.9 " << percentile(99.9) * ms << "ms max " << max() * ms << "ms";
+  out.flags(flags);
+  out.precision(precision);
+}
+
+
+size_t LatencyHistogram::bucketIndex(uint64_t value)
+{
+  if (value < kSubBucketCount)
+  {
+    return size_t(value);
+  }
+
+  // Shift the value such that the remaining bits are in [kHalfSubBucketCount, kSubBucketCount).
+  const unsigned shift = mostSignificantBit(value) - (kSubBucketBits - 1u);
+  const uint64_t sub_bucket = (value >> shift) - kHalfSubBucketCount;
+  return kSubBucketCount + size_t(shift - 1u) * kHalfSubBucketCount + size_t(sub_bucket);
+}
+
+
+uint64_t LatencyHistogram::bucketHighestValue(size_t index)
+{
+  if (index < kSubBucketCount)
+  {
+    return uint64_t(index);
+  }
+
+  const size_t offset = index - kSubBucketCount;
+  const unsigned shift = unsigned(offset / kHalfSubBucketCount) + 1u;
+  const uint64_t sub_bucket = uint64_t(offset % kHalfSubBucketCount) + kHalfSubBucketCount;
+  // Wraps to the maximum value for the last bucket.
+  return ((sub_bucket + 1u) << shift) - 1u;
+}
+}  // namespace ohmapp
@@ -0,0 +1,84 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMAPP_LATENCYHISTOGRAM_H
+#define OHMAPP_LATENCYHISTOGRAM_H
+
+#include "OhmAppConfig.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace ohmapp
+{
+/// A high dynamic range histogram of latency values for percentile reporting.
+///
+/// Values are recorded in seconds and stored as integer microseconds in log-linear buckets: values below
+/// @c kSubBucketCount microseconds are recorded exactly, while larger values are recorded within a relative error of
+/// @c 1/(kSubBucketCount/2) - better than 1%. Memory use grows only with the largest recorded value, so latencies
+/// from microseconds to hours may be recorded in the same histogram. The minimum, maximum and mean are tracked
+/// exactly.
+///
+/// Not thread safe.
+class ohmapp_API LatencyHistogram
+{
+public:
+  /// Number of bits in the linear part of each bucket.
+  static constexpr unsigned kSubBucketBits = 8u;
+  /// Number of exactly recorded values and the number of linear buckets for the first power of two range.
+  static constexpr unsigned kSubBucketCount = 1u << kSubBucketBits;
+
+  /// Record a latency value.
+  /// @param seconds The latency to record (seconds). Negative values are recorded as zero.
+  void record(double seconds);
+
+  /// Clear all recorded values.
+  void reset();
+
+  /// Query the number of recorded values.
+  /// @return The number of @c record() calls since the last @c reset() .
+  inline uint64_t count() const { return count_; }
+
+  /// Query the minimum recorded value.
+  /// @return The minimum value (seconds) or zero when empty.
+  double min() const;
+  /// Query the maximum recorded value.
+  /// @return The maximum value (seconds) or zero when empty.
+  double max() const;
+  /// Query the mean recorded value.
+  /// @return The mean value (seconds) or zero when empty.
+  double mean() const;
+
+  /// Query the value at the given percentile. The result is the highest value equivalent to the bucket containing the
+  /// percentile, so it never under reports the latency.
+  /// @param percentile The percentile to query [0, 100].
+  /// @return The percentile value (seconds) or zero when empty.
+  double percentile(double percentile) const;
+
+  /// Write a JSON object summarising the histogram: count, min, mean, max and the p50, p90, p99, p99.9 and p99.99
+  /// percentiles. All values are in seconds.
+  /// @param out The stream to write to.
+  void writeJson(std::ostream &out) const;
+
+  /// Print a one line summary of the count, mean and main percentiles in milliseconds.
+  /// @param out The stream to write to.
+  void print(std::ostream &out) const;
+
+private:
+  /// Get the bucket index for @p value microseconds.
+  static size_t bucketIndex(uint64_t value);
+  /// Get the highest value recorded in the bucket at @p index (microseconds).
+  static uint64_t bucketHighestValue(size_t index);
+
+  std::vector<uint64_t> buckets_;
+  uint64_t count_ = 0;
+  uint64_t min_ = 0;
+  uint64_t max_ = 0;
+  double total_ = 0;
+};
+}  // namespace ohmapp
+
+#endif  // OHMAPP_LATENCYHISTOGRAM_H
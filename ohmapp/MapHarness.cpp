@@ -5,17 +5,35 @@
 // Author: Kazys Stepanas
 #include "MapHarness.h"
 
+#include "BatchTuner.h"
 #include "DataSource.h"
+#include "LatencyHistogram.h"
+
+#include <ohm/Metrics.h>
 
 #include <logutil/LogUtil.h>
 
 #include <glm/vec4.hpp>
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <locale>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <psapi.h>
+#else  // _WIN32
+#include <unistd.h>
+#endif  // _WIN32
 
 // Must be after argument streaming operators.
 #include <ohmutil/Options.h>
@@ -43,13 +61,16 @@ void MapHarness::OutputOptions::configure(cxxopts::OptionAdder &adder)
   // clang-format off
   adder
     ("cloud-colour", "Colour for points in the saved cloud (if saving).", optVal(cloud_colour))
+    ("metrics", "Write runtime metrics in the Prometheus text format to this file while mapping.", optVal(metrics))
     ("output", "Output base name. Saved file paths are derived from this string adding appropriate file extensions.", optVal(base_name))
     ("q,quiet", "Run in quiet mode. Suppresses progress messages.", optVal(quiet))
     ("save-cloud", "Save a point cloud after population?", optVal(save_cloud))
     ("save-info", "Write information on how the map was generated to text file?", optVal(save_info))
     ("save-map", "Save the map object after population?", optVal(save_map))
     ("trace", "Enable debug tracing to the given file name to generate a 3es file. High performance impact.", optVal(trace)->implicit_value("trace"))
+    ("trace-capture", "Write a binary capture of the voxel changes made by traced batches to this file. Much lower overhead than 3es tracing.", optVal(trace_capture))
     ("trace-final", "Only output final map in trace.", optVal(trace_final))
+    ("trace-interval", "Only trace every Nth batch.", optVal(trace_interval))
   ;
   // clang-format on
 }
@@ -75,6 +96,10 @@ void MapHarness::OutputOptions::print(std::ostream &out)
   {
     out << "Will save: " << save_items << '\n';
   }
+  if (!metrics.empty())
+  {
+    out << "Metrics file: " << metrics << '\n';
+  }
   if (!trace.empty())
   {
 #ifdef TES_ENABLE
@@ -83,6 +108,14 @@ void MapHarness::OutputOptions::print(std::ostream &out)
     out << "3es trace ignore (not compiled)\n";
 #endif  // TES_ENABLE
   }
+  if (!trace_capture.empty())
+  {
+    out << "Trace capture file: " << trace_capture << '\n';
+  }
+  if ((!trace.empty() || !trace_capture.empty()) && trace_interval != 1)
+  {
+    out << "Trace batch interval: " << trace_interval << '\n';
+  }
 }
 
 
@@ -112,10 +145,312 @@ void MapHarness::MapOptions::print(std::ostream &out)
 }
 
 
+namespace
+{
+/// A bounded, closable FIFO of batch buffers passed between the @c MapHarness::runPipeline() stages.
+class BatchQueue
+{
+public:
+  explicit BatchQueue(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1u))
+  {}
+
+  /// Push a batch, blocking while the queue is full.
+  /// @return False if the queue has been closed, in which case @p batch is dropped.
+  bool push(std::unique_ptr<MapHarness::Batch> &&batch)
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    not_full_.wait(guard, [this]() { return closed_ || batches_.size() < capacity_; });
+    if (closed_)
+    {
+      return false;
+    }
+    batches_.emplace_back(std::move(batch));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /// Pop a batch, blocking while the queue is empty and open. Items remaining on closing may still be popped.
+  /// @return False once the queue is closed and empty.
+  bool pop(std::unique_ptr<MapHarness::Batch> &batch)
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    not_empty_.wait(guard, [this]() { return closed_ || !batches_.empty(); });
+    if (batches_.empty())
+    {
+      return false;
+    }
+    batch = std::move(batches_.front());
+    batches_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /// Close the queue, releasing any blocked threads.
+  void close()
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+private:
+  std::deque<std::unique_ptr<MapHarness::Batch>> batches_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  size_t capacity_;
+  bool closed_ = false;
+};
+
+
+/// Query the resident memory of this process.
+/// @return The resident set size (bytes) or zero when unavailable.
+uint64_t residentMemory()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    return uint64_t(counters.WorkingSetSize);
+  }
+#elif defined(__linux__)
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size_pages = 0;
+  uint64_t resident_pages = 0;
+  if (statm >> size_pages >> resident_pages)
+  {
+    return resident_pages * uint64_t(sysconf(_SC_PAGESIZE));
+  }
+#endif  // _WIN32
+  return 0;
+}
+
+
+/// Per batch latency and memory measurements for @c MapHarness::BenchmarkOptions . Only accessed from the mapping
+/// thread.
+class BenchmarkStats
+{
+public:
+  BenchmarkStats(Clock::time_point start_time, double rss_interval)
+    : start_time_(start_time)
+    , rss_interval_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(rss_interval)))
+  {
+    sampleMemory(start_time, true);
+  }
+
+  /// Record the timings for a mapped @p batch .
+  /// @param batch The batch, with @c MapHarness::Batch::arrival_time set.
+  /// @param process_start Time at which @c processBatch() was called.
+  /// @param process_end Time at which @c processBatch() returned.
+  /// @param sync_end Time at which @c syncBatch() returned.
+  void addBatch(const MapHarness::Batch &batch, Clock::time_point process_start, Clock::time_point process_end,
+                Clock::time_point sync_end)
+  {
+    const Clock::time_point arrival{ Clock::duration(batch.arrival_time) };
+    queue_.record(std::chrono::duration<double>(process_start - arrival).count());
+    integration_.record(std::chrono::duration<double>(process_end - process_start).count());
+    sync_.record(std::chrono::duration<double>(sync_end - process_end).count());
+    total_.record(std::chrono::duration<double>(sync_end - arrival).count());
+    ray_count_ += batch.timestamps.size();
+    sampleMemory(sync_end, false);
+  }
+
+  /// Sample the process resident memory if the sampling interval has elapsed or @p force is set.
+  void sampleMemory(Clock::time_point now, bool force)
+  {
+    if (force || now - last_rss_sample_ >= rss_interval_)
+    {
+      last_rss_sample_ = now;
+      const uint64_t rss = residentMemory();
+      rss_samples_.emplace_back(std::chrono::duration<double>(now - start_time_).count(), rss);
+      peak_rss_ = std::max(peak_rss_, rss);
+    }
+  }
+
+  /// Print a summary of the latencies.
+  void print(std::ostream &out) const
+  {
+    out << "Benchmark batches: " << total_.count() << '\n';
+    out << "Queue latency: ";
+    queue_.print(out);
+    out << "\nIntegration latency: ";
+    integration_.print(out);
+    out << "\nSync latency: ";
+    sync_.print(out);
+    out << "\nTotal latency: ";
+    total_.print(out);
+    out << "\nPeak resident memory: " << double(peak_rss_) / (1024.0 * 1024.0) << " MiB\n";
+  }
+
+  /// Write the JSON benchmark report to @p path .
+  /// @return True on success.
+  bool writeReport(const std::string &path, const MapHarness::BenchmarkOptions &options, double duration) const
+  {
+    std::ofstream out(path.c_str());
+    if (!out.is_open())
+    {
+      return false;
+    }
+
+    out.imbue(std::locale::classic());
+    out << std::setprecision(9);
+    out << "{\n";
+    out << "  \"rate\": " << options.rate << ",\n";
+    out << "  \"realtime\": " << options.realtime << ",\n";
+    out << "  \"duration\": " << duration << ",\n";
+    out << "  \"batches\": " << total_.count() << ",\n";
+    out << "  \"rays\": " << ray_count_ << ",\n";
+    out << "  \"rays_per_second\": " << ((duration > 0) ? double(ray_count_) / duration : 0.0) << ",\n";
+    out << "  \"latency\": {\n";
+    out << "    \"queue\": ";
+    queue_.writeJson(out);
+    out << ",\n    \"integration\": ";
+    integration_.writeJson(out);
+    out << ",\n    \"sync\": ";
+    sync_.writeJson(out);
+    out << ",\n    \"total\": ";
+    total_.writeJson(out);
+    out << "\n  },\n";
+    out << "  \"rss\": {\n";
+    out << "    \"peak\": " << peak_rss_ << ",\n";
+    out << "    \"samples\": [";
+    for (size_t i = 0; i < rss_samples_.size(); ++i)
+    {
+      out << ((i) ? ", " : "") << "[" << rss_samples_[i].first << ", " << rss_samples_[i].second << "]";
+    }
+    out << "]\n";
+    out << "  }\n";
+    out << "}\n";
+    return out.good();
+  }
+
+private:
+  LatencyHistogram queue_;
+  LatencyHistogram integration_;
+  LatencyHistogram sync_;
+  LatencyHistogram total_;
+  /// Resident memory samples: time since start (seconds) and resident set size (bytes).
+  std::vector<std::pair<double, uint64_t>> rss_samples_;
+  Clock::time_point start_time_;
+  Clock::time_point last_rss_sample_;
+  Clock::duration rss_interval_;
+  uint64_t ray_count_ = 0;
+  uint64_t peak_rss_ = 0;
+};
+}  // namespace
+
+
+MapHarness::BatchOptions::~BatchOptions() = default;
+
+
+void MapHarness::BatchOptions::configure(cxxopts::Options &parser)
+{
+  cxxopts::OptionAdder adder = parser.add_options("Batch");
+  configure(adder);
+}
+
+
+void MapHarness::BatchOptions::configure(cxxopts::OptionAdder &adder)
+{
+  // clang-format off
+  adder
+    ("batch-auto", "Tune the batch size while mapping to maximise throughput within --batch-latency. Starts from the input batch size.", optVal(auto_tune))
+    ("batch-latency", "Maximum processing time for a batch when tuning the batch size (seconds).", optVal(latency_target))
+    ("batch-max", "Maximum batch size when tuning the batch size.", optVal(max_batch_size))
+    ("batch-min", "Minimum batch size when tuning the batch size.", optVal(min_batch_size))
+    ("pipeline", "Overlap data loading, ray preparation and map integration on separate threads.", optVal(pipeline))
+    ("pipeline-depth", "Number of batches which may be queued between pipeline stages.", optVal(pipeline_depth))
+  ;
+  // clang-format on
+}
+
+
+void MapHarness::BatchOptions::print(std::ostream &out)
+{
+  if (auto_tune)
+  {
+    out << "Batch auto tune: [" << min_batch_size << ", " << max_batch_size << "] latency " << latency_target << "s\n";
+  }
+  if (pipeline)
+  {
+    out << "Pipeline depth: " << pipeline_depth << '\n';
+  }
+}
+
+
+MapHarness::BenchmarkOptions::~BenchmarkOptions() = default;
+
+
+void MapHarness::BenchmarkOptions::configure(cxxopts::Options &parser)
+{
+  cxxopts::OptionAdder adder = parser.add_options("Benchmark");
+  configure(adder);
+}
+
+
+void MapHarness::BenchmarkOptions::configure(cxxopts::OptionAdder &adder)
+{
+  // clang-format off
+  adder
+    ("benchmark", "Record per batch queueing, integration and sync latencies and resident memory, writing a JSON report.", optVal(enabled))
+    ("benchmark-rate", "Replay batches at this fixed rate (batches/second) in benchmark mode. Zero to replay as fast as possible.", optVal(rate))
+    ("benchmark-realtime", "Replay batches at this multiple of the data timestamp rate in benchmark mode. Zero to disable. Overrides --benchmark-rate.", optVal(realtime))
+    ("benchmark-report", "Benchmark JSON report file. Defaults to the output base name with the suffix '_benchmark.json'.", optVal(report))
+    ("benchmark-rss-interval", "Interval between resident memory samples in benchmark mode (seconds).", optVal(rss_interval))
+  ;
+  // clang-format on
+}
+
+
+void MapHarness::BenchmarkOptions::print(std::ostream &out)
+{
+  if (enabled)
+  {
+    out << "Benchmark report: " << report << '\n';
+    if (realtime > 0)
+    {
+      out << "Benchmark replay: " << realtime << "x data rate\n";
+    }
+    else if (rate > 0)
+    {
+      out << "Benchmark replay: " << rate << " batches/s\n";
+    }
+  }
+}
+
+
+void MapHarness::Batch::assign(const glm::dvec3 &batch_origin, const std::vector<glm::dvec3> &sensor_and_samples,
+                               const std::vector<double> &timestamps, const std::vector<float> &intensities,
+                               const std::vector<glm::vec4> &colours, const std::vector<uint8_t> &return_numbers)
+{
+  this->batch_origin = batch_origin;
+  this->sensor_and_samples.assign(sensor_and_samples.begin(), sensor_and_samples.end());
+  this->timestamps.assign(timestamps.begin(), timestamps.end());
+  this->intensities.assign(intensities.begin(), intensities.end());
+  this->colours.assign(colours.begin(), colours.end());
+  this->return_numbers.assign(return_numbers.begin(), return_numbers.end());
+}
+
+
+void MapHarness::Batch::clear()
+{
+  sensor_and_samples.clear();
+  timestamps.clear();
+  intensities.clear();
+  colours.clear();
+  return_numbers.clear();
+  arrival_time = 0;
+}
+
+
 MapHarness::Options::Options()
 {
   output_ = std::make_unique<MapHarness::OutputOptions>();
   map_ = std::make_unique<MapHarness::MapOptions>();
+  batch_ = std::make_unique<MapHarness::BatchOptions>();
+  benchmark_ = std::make_unique<MapHarness::BenchmarkOptions>();
 }
 
 
@@ -127,6 +462,8 @@ void MapHarness::Options::configure(cxxopts::Options &parser)
   parser.add_options()("h,help", "Display this help.");
   output_->configure(parser);
   map_->configure(parser);
+  batch_->configure(parser);
+  benchmark_->configure(parser);
 
   if (!positional_args.empty())
   {
@@ -141,6 +478,8 @@ void MapHarness::Options::print(std::ostream &out)
   out << std::boolalpha;
   output_->print(out);
   map_->print(out);
+  batch_->print(out);
+  benchmark_->print(out);
 }
 
 
@@ -197,6 +536,11 @@ int MapHarness::validateOptions(const cxxopts::ParseResult &parsed)
     options_->output().base_name = data_source_->sourceName();
   }
 
+  if (options_->benchmark().enabled && options_->benchmark().report.empty())
+  {
+    options_->benchmark().report = options_->output().base_name + "_benchmark.json";
+  }
+
 #ifdef TES_ENABLE
   if (!options().output().trace.empty())
   {
@@ -275,16 +619,130 @@ int MapHarness::run()
   progress_.beginProgress(ProgressMonitor::Info(predicted_point_count));
   progress_.startThread();
 
+  std::unique_ptr<BatchTuner> batch_tuner;
+  if (options_->batch().auto_tune)
+  {
+    BatchTuner::Settings settings;
+    settings.min_batch_size = options_->batch().min_batch_size;
+    settings.max_batch_size = options_->batch().max_batch_size;
+    settings.latency_target = options_->batch().latency_target;
+    batch_tuner = std::make_unique<BatchTuner>(data_source_->expectedBatchSize(), settings);
+    data_source_->updateBatchSize(batch_tuner->batchSize());
+  }
+
+  // Tuned batch sizes are passed to the data source from its own thread as the mapping thread may differ.
+  std::atomic<unsigned> pending_batch_size{ 0u };
+  const auto apply_batch_size = [this, &pending_batch_size]()  //
+  {
+    const unsigned batch_size = pending_batch_size.exchange(0u);
+    if (batch_size)
+    {
+      data_source_->updateBatchSize(batch_size);
+    }
+  };
+
+  const BenchmarkOptions &benchmark = options_->benchmark();
+  std::unique_ptr<BenchmarkStats> benchmark_stats;
+  if (benchmark.enabled)
+  {
+    benchmark_stats = std::make_unique<BenchmarkStats>(Clock::now(), benchmark.rss_interval);
+  }
+
+  // Benchmark replay state. Only accessed from the data source thread.
+  Clock::time_point replay_start;
+  double replay_first_timestamp = 0;
+  uint64_t replay_batch_count = 0;
+  const auto on_read_batch = [&benchmark, &apply_batch_size, &replay_start, &replay_first_timestamp,
+                              &replay_batch_count](Batch &batch)  //
+  {
+    apply_batch_size();
+    if (!benchmark.enabled)
+    {
+      return;
+    }
+
+    // A batch is available once its last sample has been received.
+    const double batch_timestamp = (!batch.timestamps.empty()) ? batch.timestamps.back() : 0.0;
+    Clock::time_point arrival = Clock::now();
+    if (replay_batch_count == 0)
+    {
+      replay_start = arrival;
+      replay_first_timestamp = batch_timestamp;
+    }
+    else if (benchmark.realtime > 0 || benchmark.rate > 0)
+    {
+      const double replay_time = (benchmark.realtime > 0) ?
+                                   (batch_timestamp - replay_first_timestamp) / benchmark.realtime :
+                                   double(replay_batch_count) / benchmark.rate;
+      // Latency is measured from the scheduled arrival, even if the batch is read late.
+      arrival = replay_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(replay_time));
+      std::this_thread::sleep_until(arrival);
+    }
+    ++replay_batch_count;
+    batch.arrival_time = arrival.time_since_epoch().count();
+  };
+
+  const auto map_batch = [this, &batch_tuner, &pending_batch_size, &benchmark_stats](const Batch &batch)  //
+  {
+    const Clock::time_point batch_start = Clock::now();
+    const bool result = processBatch(batch.batch_origin, batch.sensor_and_samples, batch.timestamps,
+                                     batch.intensities, batch.colours, batch.return_numbers);
+    const Clock::time_point batch_end = Clock::now();
+    if (benchmark_stats)
+    {
+      syncBatch();
+      benchmark_stats->addBatch(batch, batch_start, batch_end, Clock::now());
+    }
+    if (batch_tuner)
+    {
+      DataSource::Stats batch_stats;
+      batch_stats.process_time_end = std::chrono::duration<double>(batch_end - batch_start).count();
+      batch_stats.ray_count = batch.timestamps.size();
+      if (batch_tuner->addBatch(batch_stats))
+      {
+        pending_batch_size = batch_tuner->batchSize();
+      }
+    }
+    return result;
+  };
+
   const Clock::time_point start_time = Clock::now();
-  data_source_->run(
-    std::bind(&MapHarness::processBatch, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3,
-              std::placeholders::_4, std::placeholders::_5, std::placeholders::_6),
-    quitLevelPtr());
+  if (options_->batch().pipeline)
+  {
+    runPipeline(map_batch, on_read_batch);
+  }
+  else
+  {
+    Batch batch;
+    data_source_->run(
+      [this, &batch, &map_batch, &on_read_batch](
+        const glm::dvec3 &batch_origin, const std::vector<glm::dvec3> &sensor_and_samples,
+        const std::vector<double> &timestamps, const std::vector<float> &intensities,
+        const std::vector<glm::vec4> &colours, const std::vector<uint8_t> &return_numbers)  //
+      {
+        batch.assign(batch_origin, sensor_and_samples, timestamps, intensities, colours, return_numbers);
+        on_read_batch(batch);
+        prepareBatch(batch);
+        return map_batch(batch);
+      },
+      quitLevelPtr());
+  }
   progress_.endProgress();
   progress_.pause();
   display_stats_in_progress_ = false;
   finaliseMap();
   const Clock::time_point end_time = Clock::now();
+  writeMetrics();
+
+  if (benchmark_stats)
+  {
+    benchmark_stats->sampleMemory(end_time, true);
+    if (!benchmark_stats->writeReport(benchmark.report, benchmark,
+                                      std::chrono::duration<double>(end_time - start_time).count()))
+    {
+      logutil::warn("Unable to write benchmark report ", benchmark.report, '\n');
+    }
+  }
 
   const double time_range = data_source_->processedTimeRange();
   const uint64_t processed_count = data_source_->processedPointCount();
@@ -307,6 +765,14 @@ int MapHarness::run()
         *out << "Average samples/sec: "
              << unsigned((processing_time_sec > 0) ? processed_count / processing_time_sec : 0.0) << '\n';
         // *out << "Memory (approx): " << map.calculateApproximateMemory() / (1024.0 * 1024.0) << " MiB\n";
+        if (batch_tuner)
+        {
+          *out << "Tuned batch size: " << batch_tuner->batchSize() << '\n';
+        }
+        if (benchmark_stats)
+        {
+          benchmark_stats->print(*out);
+        }
         *out << std::flush;
 
         if (data_source_->options().stats_mode != DataSource::StatsMode::Off)
@@ -327,6 +793,77 @@ int MapHarness::run()
 }
 
 
+void MapHarness::runPipeline(const std::function<bool(const Batch &)> &map_batch,
+                             const std::function<void(Batch &)> &on_read_batch)
+{
+  const size_t depth = std::max(1u, options_->batch().pipeline_depth);
+  // Enough buffers to fill both queues with one more batch in each stage.
+  const size_t buffer_count = 2 * depth + 3;
+  BatchQueue free_batches(buffer_count);
+  BatchQueue read_batches(depth);
+  BatchQueue prepared_batches(depth);
+  for (size_t i = 0; i < buffer_count; ++i)
+  {
+    free_batches.push(std::make_unique<Batch>());
+  }
+
+  // Stage 1: load samples, building the ray arrays.
+  std::thread reader([this, &free_batches, &read_batches, &on_read_batch]()  //
+                     {
+                       data_source_->run(
+                         [&free_batches, &read_batches, &on_read_batch](
+                           const glm::dvec3 &batch_origin, const std::vector<glm::dvec3> &sensor_and_samples,
+                           const std::vector<double> &timestamps, const std::vector<float> &intensities,
+                           const std::vector<glm::vec4> &colours, const std::vector<uint8_t> &return_numbers)  //
+                         {
+                           std::unique_ptr<Batch> batch;
+                           if (!free_batches.pop(batch))
+                           {
+                             return false;
+                           }
+                           batch->assign(batch_origin, sensor_and_samples, timestamps, intensities, colours,
+                                         return_numbers);
+                           on_read_batch(*batch);
+                           return read_batches.push(std::move(batch));
+                         },
+                         quitLevelPtr());
+                       read_batches.close();
+                     });
+
+  // Stage 2: prepare the rays.
+  std::thread preparer([this, &read_batches, &prepared_batches]()  //
+                       {
+                         std::unique_ptr<Batch> batch;
+                         while (read_batches.pop(batch))
+                         {
+                           prepareBatch(*batch);
+                           if (!prepared_batches.push(std::move(batch)))
+                           {
+                             break;
+                           }
+                         }
+                         prepared_batches.close();
+                       });
+
+  // Stage 3: integrate into the map on this thread, recycling the batch buffers.
+  std::unique_ptr<Batch> batch;
+  bool keep_mapping = true;
+  while (keep_mapping && prepared_batches.pop(batch))
+  {
+    keep_mapping = map_batch(*batch);
+    batch->clear();
+    free_batches.push(std::move(batch));
+  }
+
+  // Release the other stages should mapping have stopped early.
+  free_batches.close();
+  read_batches.close();
+  prepared_batches.close();
+  reader.join();
+  preparer.join();
+}
+
+
 void MapHarness::configureOptions(cxxopts::Options &parser)
 {
   data_source_->configure(parser);
@@ -362,6 +899,23 @@ int MapHarness::serialise()
 
 void MapHarness::displayProgress(const ProgressMonitor::Progress &progress, bool final)
 {
+  if (!options_->output().metrics.empty())
+  {
+    const auto now = Clock::now().time_since_epoch().count();
+    const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)).count();
+    if (now - last_metrics_write_ >= interval)
+    {
+      last_metrics_write_ = now;
+      if (display_stats_in_progress_)
+      {
+        static ohm::metrics::Gauge &rays_per_second = ohm::metrics::Registry::global().gauge(
+          "ohmapp_windowed_rays_per_second", "Ray processing rate over the recent sample window.");
+        rays_per_second.set(data_source_->windowedStats().processRaysPerSecond());
+      }
+      writeMetrics();
+    }
+  }
+
   if (!quiet())
   {
     const double elapsed_sec = data_source_->processedTimeRange();
@@ -407,4 +961,27 @@ void MapHarness::displayProgress(const ProgressMonitor::Progress &progress, bool
     logutil::info(out.str());
   }
 }
+
+
+void MapHarness::writeMetrics()
+{
+  const std::string &path = options_->output().metrics;
+  if (path.empty())
+  {
+    return;
+  }
+
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path.c_str());
+    if (!out.is_open())
+    {
+      logutil::warn("Unable to write metrics file ", tmp_path, '\n');
+      return;
+    }
+    ohm::metrics::Registry::global().writePrometheus(out);
+  }
+  std::remove(path.c_str());
+  std::rename(tmp_path.c_str(), path.c_str());
+}
 }  // namespace ohmapp
@@ -17,6 +17,7 @@
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <string>
@@ -70,6 +71,10 @@ public:
     std::string trace;
     /// Only use 3es to visualise the final map?
     bool trace_final = false;
+    /// Only trace every Nth batch. See @c ohm::RayMapperTrace::setBatchInterval() .
+    unsigned trace_interval = 1;
+    /// Binary trace capture file, written instead of live 3es emission. See @c ohm::RayMapperTrace::openCapture() .
+    std::string trace_capture;
     /// Save the map file?
     bool save_map = true;
     /// Save a point cloud form the map?
@@ -78,6 +83,8 @@ public:
     bool save_info = false;
     /// Suppress console output.
     bool quiet = false;
+    /// File to write @c ohm::metrics in the Prometheus text format to while mapping. Disabled when empty.
+    std::string metrics;
 
     OutputOptions();
     virtual ~OutputOptions();
@@ -116,6 +123,75 @@ public:
     virtual void print(std::ostream &out);
   };
 
+  /// Options controlling online tuning of the data source batch size - see @c BatchTuner .
+  struct ohmapp_API BatchOptions
+  {
+    /// Tune the batch size while mapping? The data source batch size sets the initial size.
+    bool auto_tune = false;
+    /// Maximum processing time for a batch (seconds).
+    double latency_target = 0.1;
+    /// Minimum tuned batch size.
+    unsigned min_batch_size = 1024;
+    /// Maximum tuned batch size.
+    unsigned max_batch_size = 1u << 20u;
+    /// Run data loading, @c prepareBatch() and @c processBatch() as a three stage pipeline on separate threads?
+    bool pipeline = false;
+    /// Number of batches which may be queued between each pipeline stage.
+    unsigned pipeline_depth = 2;
+
+    virtual ~BatchOptions();
+
+    /// Configure the command line options for the given @c parser . Calls @c `configure(const cxxopts::OptionAdder &)`
+    /// @param parser The command line parser.
+    void configure(cxxopts::Options &parser);
+    /// Add command line options. Derivations should override this to add their own options as well as calling this
+    /// base version.
+    /// @param adder Object to add command line options to.
+    virtual void configure(cxxopts::OptionAdder &adder);
+    /// Print command line options to the given stream.
+    /// Derivations should override this to print their own options as well as calling this base version.
+    /// @param out Output stream to print configured options to.
+    virtual void print(std::ostream &out);
+  };
+
+  /// Options controlling the latency benchmark mode.
+  ///
+  /// In benchmark mode, each batch is timed from the time it becomes available - its arrival - to the completion of its
+  /// integration. The latency is split into the queueing time before @c processBatch() starts, the
+  /// @c processBatch() time and the @c syncBatch() time. Each is recorded in a @c LatencyHistogram and percentiles
+  /// are reported on completion, along with the process resident memory sampled over time.
+  ///
+  /// The dataset may be replayed at a fixed batch rate or at a multiple of the data timestamp rate. Batch arrival times
+  /// are then the scheduled times rather than the times the batches were read, so a stalled pipeline is reported as
+  /// queueing latency for all the batches it delays.
+  struct ohmapp_API BenchmarkOptions
+  {
+    /// Enable benchmark mode?
+    bool enabled = false;
+    /// Fixed batch replay rate (batches per second). Zero to read batches as fast as they are consumed.
+    double rate = 0;
+    /// Replay at this multiple of the data timestamp rate. Zero to disable. Overrides @c rate .
+    double realtime = 0;
+    /// JSON report file path. Defaults to the output base name with a @c '_benchmark.json' suffix.
+    std::string report;
+    /// Interval between process resident memory samples (seconds).
+    double rss_interval = 1.0;
+
+    virtual ~BenchmarkOptions();
+
+    /// Configure the command line options for the given @c parser . Calls @c `configure(const cxxopts::OptionAdder &)`
+    /// @param parser The command line parser.
+    void configure(cxxopts::Options &parser);
+    /// Add command line options. Derivations should override this to add their own options as well as calling this
+    /// base version.
+    /// @param adder Object to add command line options to.
+    virtual void configure(cxxopts::OptionAdder &adder);
+    /// Print command line options to the given stream.
+    /// Derivations should override this to print their own options as well as calling this base version.
+    /// @param out Output stream to print configured options to.
+    virtual void print(std::ostream &out);
+  };
+
   /// Collated options.
   struct ohmapp_API Options
   {
@@ -123,11 +199,15 @@ public:
     std::unique_ptr<OutputOptions> output_;
     /// The map options.
     std::unique_ptr<MapOptions> map_;
+    /// The batch tuning options.
+    std::unique_ptr<BatchOptions> batch_;
+    /// The benchmark options.
+    std::unique_ptr<BenchmarkOptions> benchmark_;
 
     /// Positional argument names set when @c configure() is called.
     std::vector<std::string> positional_args = { "cloud", "trajectory", "output" };
     /// List of help sections to show when @c --help is used.
-    std::vector<std::string> default_help_sections = { "", "Input", "Output", "Map" };
+    std::vector<std::string> default_help_sections = { "", "Input", "Output", "Map", "Batch", "Benchmark" };
 
     Options();
     virtual ~Options();
@@ -146,6 +226,18 @@ public:
     /// @overload
     inline const MapOptions &map() const { return *map_; }
 
+    /// Access the batch tuning options by reference.
+    /// @return The @c BatchOptions .
+    inline BatchOptions &batch() { return *batch_; }
+    /// @overload
+    inline const BatchOptions &batch() const { return *batch_; }
+
+    /// Access the benchmark options by reference.
+    /// @return The @c BenchmarkOptions .
+    inline BenchmarkOptions &benchmark() { return *benchmark_; }
+    /// @overload
+    inline const BenchmarkOptions &benchmark() const { return *benchmark_; }
+
     /// Configure the command line options for the given @c parser . Calls @c `configure(const cxxopts::OptionAdder &)`
     /// @param parser The command line parser.
     virtual void configure(cxxopts::Options &parser);
@@ -155,6 +247,34 @@ public:
     virtual void print(std::ostream &out);
   };
 
+  /// Sample data for one batch, as passed to @c processBatch() . Used to pass batches between threads when
+  /// @c BatchOptions::pipeline is set. Buffers are recycled between batches to avoid allocation.
+  struct ohmapp_API Batch
+  {
+    /// The sensor position for the first point in the batch.
+    glm::dvec3 batch_origin{ 0 };
+    /// Sensor/sample point pairs or just sample points.
+    std::vector<glm::dvec3> sensor_and_samples;
+    /// Time stamps for each sample point.
+    std::vector<double> timestamps;
+    /// Intensity values for each sample point.
+    std::vector<float> intensities;
+    /// Colour values for each sample point.
+    std::vector<glm::vec4> colours;
+    /// Return numbers for each sample point.
+    std::vector<uint8_t> return_numbers;
+    /// Time at which the batch became available in @c Clock ticks. Only set in benchmark mode.
+    int64_t arrival_time = 0;
+
+    /// Copy the given batch data into this object, reusing the allocated memory.
+    void assign(const glm::dvec3 &batch_origin, const std::vector<glm::dvec3> &sensor_and_samples,
+                const std::vector<double> &timestamps, const std::vector<float> &intensities,
+                const std::vector<glm::vec4> &colours, const std::vector<uint8_t> &return_numbers);
+
+    /// Clear the batch data, retaining the allocated memory.
+    void clear();
+  };
+
   /// Create a harness with the given options specialisation.
   ///
   /// Takes ownership of the pointer. @p options should generally be a specialisation of @c Options .
@@ -194,9 +314,13 @@ public:
   ///   multiple times displaying to different streams
   /// - Calls @c DataSource::prepareForRun()
   /// - Starts the @c progress() thread.
-  /// - Calls @c DataSource::run() . This calls contains main execution loop.
+  /// - Calls @c DataSource::run() . This calls contains main execution loop. Each @c processBatch() call is timed and
+  ///   the @c DataSource batch size updated when @c BatchOptions::auto_tune is set. With @c BatchOptions::pipeline ,
+  ///   @c DataSource::run() executes on a reader thread, @c prepareBatch() on a second thread and @c processBatch() on
+  ///   the calling thread, with batches passed between the stages by bounded queues. With
+  ///   @c BenchmarkOptions::enabled , batches are paced and each batch latency is recorded.
   /// - Calls @c finaliseMap(). Serialisation may occur from here.
-  /// - Displays statistics
+  /// - Displays statistics and writes the benchmark report when enabled.
   /// - Calls @c tearDown()
   ///
   /// Note that @c tearDown() is called out of sequence if any failures occur during execution. That is, @c tearDown()
@@ -304,6 +428,20 @@ protected:
                             const std::vector<double> &timestamps, const std::vector<float> &intensities,
                             const std::vector<glm::vec4> &colours, const std::vector<uint8_t> &return_numbers) = 0;
 
+  /// Prepare a batch before it is passed to @c processBatch() - e.g., to filter or transform the samples.
+  ///
+  /// With @c BatchOptions::pipeline set this is called on a dedicated thread, concurrently with the data loading of
+  /// the next batch and the @c processBatch() call for the previous batch, so it must not access the map. Otherwise it
+  /// is called immediately before @c processBatch() . The default implementation does nothing.
+  ///
+  /// @param batch The batch data to modify.
+  inline virtual void prepareBatch(Batch &batch) { (void)batch; }
+
+  /// Block until the map changes made by the last @c processBatch() call have completed. Used to time the completion
+  /// of asynchronous integration, such as GPU ray processing, separately from @c processBatch() in benchmark mode.
+  /// The default implementation does nothing.
+  inline virtual void syncBatch() {}
+
   /// Called after app data have been added to the map to finalise.
   inline virtual void finaliseMap() {}
 
@@ -327,6 +465,10 @@ protected:
   /// Callback for @c ProgressMonitor::setDisplayFunction() which displays to @c std::cout reusing the same line (\\r).
   virtual void displayProgress(const ProgressMonitor::Progress &progress, bool final);
 
+  /// Write the @c ohm::metrics::Registry::global() metrics to @c OutputOptions::metrics , if set. The file is written
+  /// to a temporary file then renamed so a scraper never sees a partial file.
+  void writeMetrics();
+
   /// Options for the populator. May be a derivation of @c MapHarness::Options .
   std::unique_ptr<Options> options_;
   /// Progress reporting thread helper.
@@ -336,6 +478,13 @@ protected:
   std::unique_ptr<ohm::Trace> trace_;
 
 private:
+  /// Run the @c DataSource as a three stage pipeline - see @c BatchOptions::pipeline .
+  /// @param map_batch Function which calls @c processBatch() for a prepared batch, returning false to stop.
+  /// @param on_read_batch Function called from the data source thread for each batch read, after assigning the batch
+  /// data.
+  void runPipeline(const std::function<bool(const Batch &)> &map_batch,
+                   const std::function<void(Batch &)> &on_read_batch);
+
   /// Time elapsed in the input data set timestamps (milliseconds).
   std::atomic<uint64_t> dataset_elapsed_ms_;
   /// Object from which samples are loaded.
@@ -348,6 +497,8 @@ private:
   /// Called after @c prepareForRun() for external notification.
   GeneralCallback on_start_callback_;
   bool display_stats_in_progress_ = false;
+  /// Time of the last @c writeMetrics() call from @c displayProgress() in @c Clock ticks.
+  std::atomic<int64_t> last_metrics_write_{ 0 };
 };
 }  // namespace ohmapp
 
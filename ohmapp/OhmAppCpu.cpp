@@ -23,10 +23,6 @@
 
 #include <ohmapp/DataSource.h>
 
-#ifdef TES_ENABLE
-#include <ohm/RayMapperTrace.h>
-#endif  // TES_ENABLE
-
 #include <ohmtools/OhmCloud.h>
 
 #include <logutil/LogUtil.h>
@@ -261,6 +257,7 @@ void OhmAppCpu::CompressionOptions::configure(cxxopts::OptionAdder &adder)
     ("high-tide", "Set the high memory tide which the background compression thread will try keep below.", optVal(high_tide))
     ("low-tide", "Set the low memory tide to which the background compression thread will try reduce to once high-tide is exceeded.", optVal(low_tide))
     ("uncompressed", "Maintain uncompressed map. By default, may regions may be compressed when no longer needed.", optVal(uncompressed))
+    ("uniform-blocks", "Do not allocate voxel memory for region layers which hold the same value for every voxel.", optVal(uniform_blocks))
   ;
   // clang-format on
 }
@@ -274,6 +271,7 @@ void OhmAppCpu::CompressionOptions::print(std::ostream &out)
     out << "  High tide: " << high_tide << '\n';
     out << "  Low tide: " << low_tide << '\n';
   }
+  out << "Uniform blocks: " << (uniform_blocks ? "on" : "off") << '\n';
 }
 
 
@@ -406,6 +404,7 @@ int OhmAppCpu::prepareForRun()
   ohm::MapFlag map_flags = ohm::MapFlag::kDefault;
   map_flags |= (options().map().voxel_mean) ? ohm::MapFlag::kVoxelMean : ohm::MapFlag::kNone;
   map_flags &= (options().compression().uncompressed) ? ~ohm::MapFlag::kCompressed : ~ohm::MapFlag::kNone;
+  map_flags |= (options().compression().uniform_blocks) ? ohm::MapFlag::kUniformBlocks : ohm::MapFlag::kNone;
   map_ = std::make_unique<ohm::OccupancyMap>(options().map().resolution, options().map().region_voxel_dim, map_flags);
 
   // Make sure we build layers before initialising any GPU map. Otherwise we can cache the wrong GPU programs.
@@ -478,13 +477,21 @@ int OhmAppCpu::prepareForRun()
   }
 
   mapper_ = true_mapper_.get();
+  bool trace_live = false;
 #ifdef TES_ENABLE
-  if (!options().output().trace.empty() && !options().output().trace_final)
+  trace_live = !options().output().trace.empty() && !options().output().trace_final;
+#endif  // TES_ENABLE
+  if (trace_live || !options().output().trace_capture.empty())
   {
     trace_mapper_ = std::make_unique<ohm::RayMapperTrace>(map_.get(), true_mapper_.get());
+    trace_mapper_->setLiveEmission(trace_live);
+    trace_mapper_->setBatchInterval(options().output().trace_interval);
+    if (!options().output().trace_capture.empty() && !trace_mapper_->openCapture(options().output().trace_capture))
+    {
+      logutil::error("Failed to open trace capture: ", options().output().trace_capture, '\n');
+    }
     mapper_ = trace_mapper_.get();
   }
-#endif  // TES_ENABLE
 
   if (dataSource()->options().return_number_mode != DataSource::ReturnNumberMode::Off)
   {
@@ -544,6 +551,10 @@ bool OhmAppCpu::processBatch(const glm::dvec3 &batch_origin, const std::vector<g
 
 void OhmAppCpu::finaliseMap()
 {
+  if (trace_mapper_)
+  {
+    trace_mapper_->closeCapture();
+  }
 #ifdef TES_ENABLE
   if (map_)
   {
@@ -653,9 +664,7 @@ void OhmAppCpu::tearDown()
 {
   // ndt_map->debugDraw();
   mapper_ = nullptr;
-#ifdef TES_ENABLE
   trace_mapper_.release();
-#endif  // TES_ENABLE
   true_mapper_.release();
   ndt_map_.release();
   map_.release();
@@ -15,6 +15,7 @@
 #include <ohm/NdtMode.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/RayMapper.h>
+#include <ohm/RayMapperTrace.h>
 #include <ohm/VoxelTsdf.h>
 
 #include <logutil/LogUtil.h>
@@ -136,6 +137,8 @@ public:
     logutil::Bytes low_tide;
     /// True to disable compression.
     bool uncompressed = false;
+    /// True to elide the voxel memory of uniform region layers. See @c ohm::MapFlag::kUniformBlocks .
+    bool uniform_blocks = false;
 
     CompressionOptions();
     virtual ~CompressionOptions();
@@ -230,7 +233,7 @@ protected:
   /// The @c RayMapper used to add points to the map.
   std::unique_ptr<ohm::RayMapper> true_mapper_;
   /// Debug drawing mapper. Installed in @c mapper_ when tracing is enabled.
-  std::unique_ptr<ohm::RayMapper> trace_mapper_;
+  std::unique_ptr<ohm::RayMapperTrace> trace_mapper_;
   /// Mapper for seconary sample points (dual returns).
   std::unique_ptr<ohm::RayMapper> secondary_sample_mapper_;
   /// Dual returns buffer.
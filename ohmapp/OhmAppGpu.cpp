@@ -8,27 +8,73 @@
 #include <logutil/LogUtil.h>
 
 #include <ohmgpu/GpuCache.h>
+#include <ohmgpu/GpuHybridMap.h>
 #include <ohmgpu/GpuMap.h>
 #include <ohmgpu/GpuNdtMap.h>
+#include <ohmgpu/GpuSecondarySampleMap.h>
 #include <ohmgpu/GpuTsdfMap.h>
 #include <ohmgpu/OhmGpu.h>
 
 #include <ohmapp/DataSource.h>
 
 #include <ohm/DefaultLayer.h>
-#include <ohm/RayMapperSecondarySample.h>
 
-#ifdef TES_ENABLE
 #include <ohm/RayMapperTrace.h>
-#endif  // TES_ENABLE
 
 #include <gputil/gpuDevice.h>
+#include <gputil/gpuProfiler.h>
+#include <gputil/gpuQueue.h>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
 
 // Must be after any argument type streaming operators.
 #include <ohmutil/Options.h>
 
 namespace ohmapp
 {
+namespace
+{
+/// Log the GPU timing collected by @p profiler .
+void logGpuProfile(gputil::Profiler &profiler)
+{
+  const std::vector<gputil::ProfileStats> &stats = profiler.stats();
+  const unsigned batch_count = std::max(1u, profiler.batchCount());
+  std::ostringstream out;
+  out << "GPU profile: " << profiler.batchCount() << " batch(es)\n";
+  for (const gputil::ProfileStats &item : stats)
+  {
+    if (item.count == 0)
+    {
+      continue;
+    }
+    out << "  " << item.name << ": " << item.count << " call(s), total ";
+    logutil::logDuration(out, std::chrono::nanoseconds(item.exec_ns));
+    out << ", mean ";
+    logutil::logDuration(out, std::chrono::nanoseconds(item.exec_ns / item.count));
+    out << ", max ";
+    logutil::logDuration(out, std::chrono::nanoseconds(item.max_exec_ns));
+    out << ", per batch ";
+    logutil::logDuration(out, std::chrono::nanoseconds(item.exec_ns / batch_count));
+    out << ", queued ";
+    logutil::logDuration(out, std::chrono::nanoseconds(item.wait_ns));
+    if (item.bytes)
+    {
+      const double seconds = double(item.exec_ns) * 1e-9;
+      out << ", " << logutil::Bytes(size_t(item.bytes));
+      if (seconds > 0)
+      {
+        out << " (" << logutil::Bytes(size_t(double(item.bytes) / seconds)) << "/s)";
+      }
+    }
+    out << '\n';
+  }
+  logutil::info(out.str());
+}
+}  // namespace
+
 OhmAppGpu::GpuOptions::GpuOptions()
 {
   // Build GPU options set.
@@ -52,6 +98,11 @@ void OhmAppGpu::GpuOptions::configure(cxxopts::Options &parser)
     ("gpu-cache-size", "Configured the GPU cache size used to cache regions for GPU update. Floating point value specified in GiB. A zero value uses half the available GPU RAM, 1GiB or 3/4 of RAM in order of preference.", optVal(cache_size_gb))
     ("gpu-ray-segment-length", "Configure the maximum allowed ray length for a single GPU thread to process. Longer rays are broken into multiple segments.", optVal(ray_segment_length))
     ("forward", "Perform forward ray tracing. GPU defaults to reverse ray tracing for performance (lower voxel contention).", optVal(forward_trace))
+    ("gpu-aggregate", "Aggregate updates to the same voxel in GPU local memory before writing the map. Reduces contention for dense, near field rays.", optVal(aggregate_updates))
+    ("gpu-transfer-queue", "Use a dedicated GPU queue for region uploads and downloads so they overlap ray processing.", optVal(transfer_queue))
+    ("gpu-profile", "Profile GPU kernels and transfers, reporting device timing per command type and per batch on completion. Adds some overhead.", optVal(profile))
+    ("gpu-hybrid", "Split occupancy ray integration between the GPU and CPU threads by map region, dynamically balancing the CPU share from the measured throughput. Not supported with NDT or TSDF.", optVal(hybrid))
+    ("gpu-hybrid-cpu-share", "Initial fraction of the map regions integrated on CPU with --gpu-hybrid [0, 1].", optVal(hybrid_cpu_share))
     ;
 
   // clang-format on
@@ -72,6 +123,14 @@ void OhmAppGpu::GpuOptions::print(std::ostream &out)
   out << "Gpu cache size: " << logutil::Bytes(gpuCacheSizeBytes()) << '\n';
   out << "Gpu max ray segment: " << ray_segment_length << '\n';
   out << "Gpu ray tracing: " << (forward_trace ? "forward" : "reverse") << '\n';
+  out << "Gpu aggregate updates: " << (aggregate_updates ? "on" : "off") << '\n';
+  out << "Gpu transfer queue: " << (transfer_queue ? "on" : "off") << '\n';
+  out << "Gpu profile: " << (profile ? "on" : "off") << '\n';
+  out << "Gpu hybrid: " << (hybrid ? "on" : "off") << '\n';
+  if (hybrid)
+  {
+    out << "Gpu hybrid CPU share: " << hybrid_cpu_share << '\n';
+  }
 }
 
 
@@ -143,6 +202,10 @@ int OhmAppGpu::parseCommandLineOptions(int argc, const char *const *argv)
 
 ohm::GpuMap *OhmAppGpu::gpuMap()
 {
+  if (auto *hybrid_map = dynamic_cast<ohm::GpuHybridMap *>(true_mapper_.get()))
+  {
+    return &hybrid_map->gpuMap();
+  }
   if (true_mapper_)
   {
     return static_cast<ohm::GpuMap *>(true_mapper_.get());
@@ -153,6 +216,10 @@ ohm::GpuMap *OhmAppGpu::gpuMap()
 
 const ohm::GpuMap *OhmAppGpu::gpuMap() const
 {
+  if (auto *hybrid_map = dynamic_cast<const ohm::GpuHybridMap *>(true_mapper_.get()))
+  {
+    return &hybrid_map->gpuMap();
+  }
   if (true_mapper_)
   {
     return static_cast<const ohm::GpuMap *>(true_mapper_.get());
@@ -184,6 +251,37 @@ int OhmAppGpu::prepareForRun()
     options().map().ray_mode_flags |= ohm::kRfReverseWalk;
   }
 
+  unsigned gpu_flags = ohm::gpumap::kGpuAllowMappedBuffers;
+  gpu_flags |= (options().gpu().transfer_queue) ? ohm::gpumap::kGpuTransferQueue : 0u;
+  gpu_flags |= (options().gpu().profile) ? ohm::gpumap::kGpuProfile : 0u;
+  if (gpu_flags != ohm::gpumap::kGpuAllowMappedBuffers)
+  {
+    // Enable GPU ahead of the mapper, which otherwise enables it with the default flags.
+    ohm::gpumap::enableGpu(*map_, gpu_cache_size, gpu_flags);
+  }
+
+  // Install the ray filter ahead of the mapper. The GpuHybridMap copies the filter on construction.
+  if (options().map().ray_length_max > 0)
+  {
+    const auto ray_length_max = options().map().ray_length_max;
+    map_->setRayFilter([ray_length_max](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
+      return ohm::clipRayFilter(start, end, filter_flags, ray_length_max);
+    });
+  }
+  else
+  {
+    // No ray length filter installed, but make sure we skip bad rays.
+    // GPU deals very poorly with Inf/NaN values.
+    map_->setRayFilter([](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
+      return ohm::goodRayFilter(start, end, filter_flags, 0);
+    });
+  }
+
+  if (options().gpu().hybrid && (options().ndt().mode != ohm::NdtMode::kNone || options().map().tsdf_enabled))
+  {
+    logutil::warn("GPU hybrid mode only supports occupancy. Using GPU only.\n");
+  }
+
   if (options().ndt().mode != ohm::NdtMode::kNone)
   {
     true_mapper_ =
@@ -199,12 +297,18 @@ int OhmAppGpu::prepareForRun()
     tsdf_mapper->setTsdfOptions(options().map().tsdf);
     true_mapper_ = std::move(tsdf_mapper);
   }
+  else if (options().gpu().hybrid)
+  {
+    true_mapper_ = std::make_unique<ohm::GpuHybridMap>(map_.get(), reserve_batch_size, gpu_cache_size,
+                                                       options().gpu().hybrid_cpu_share);
+  }
   else
   {
     true_mapper_ = std::make_unique<ohm::GpuMap>(map_.get(), true, reserve_batch_size, gpu_cache_size);
   }
   ohm::GpuMap *gpu_map = gpuMap();
   gpu_map->setRaySegmentLength(options().gpu().ray_segment_length);
+  gpu_map->setAggregateUpdates(options().gpu().aggregate_updates);
 
   if (bool(options().ndt().mode))
   {
@@ -219,36 +323,28 @@ int OhmAppGpu::prepareForRun()
   options().map().voxel_mean = map_->voxelMeanEnabled();
   options().map().traversal = map_->traversalEnabled();
 
-  if (options().map().ray_length_max > 0)
-  {
-    const auto ray_length_max = options().map().ray_length_max;
-    map_->setRayFilter([ray_length_max](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
-      return ohm::clipRayFilter(start, end, filter_flags, ray_length_max);
-    });
-  }
-  else
-  {
-    // No ray length filter installed, but make sure we skip bad rays.
-    // GPU deals very poorly with Inf/NaN values.
-    map_->setRayFilter([](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
-      return ohm::goodRayFilter(start, end, filter_flags, 0);
-    });
-  }
-
   mapper_ = true_mapper_.get();
+  bool trace_live = false;
 #ifdef TES_ENABLE
-  if (!options().output().trace.empty() && !options().output().trace_final)
+  trace_live = !options().output().trace.empty() && !options().output().trace_final;
+#endif  // TES_ENABLE
+  if (trace_live || !options().output().trace_capture.empty())
   {
     trace_mapper_ = std::make_unique<ohm::RayMapperTrace>(map_.get(), true_mapper_.get());
+    trace_mapper_->setLiveEmission(trace_live);
+    trace_mapper_->setBatchInterval(options().output().trace_interval);
+    if (!options().output().trace_capture.empty() && !trace_mapper_->openCapture(options().output().trace_capture))
+    {
+      logutil::error("Failed to open trace capture: ", options().output().trace_capture, '\n');
+    }
     mapper_ = trace_mapper_.get();
   }
-#endif  // TES_ENABLE
 
   if (dataSource()->options().return_number_mode != DataSource::ReturnNumberMode::Off)
   {
-    map_->addLayer(ohm::default_layer::secondarySamplesLayerName(), ohm::addSecondarySamples);
-
-    secondary_sample_mapper_ = std::make_unique<ohm::RayMapperSecondarySample>(map_.get());
+    // Integrate the secondary samples on GPU. This adds the secondary samples layer.
+    secondary_sample_mapper_ =
+      std::make_unique<ohm::GpuSecondarySampleMap>(map_.get(), true, reserve_batch_size, gpu_cache_size);
     if (!secondary_sample_mapper_->valid())
     {
       secondary_sample_mapper_ = nullptr;
@@ -259,12 +355,42 @@ int OhmAppGpu::prepareForRun()
 }
 
 
+void OhmAppGpu::syncBatch()
+{
+  // Wait for the queued ray integration without synchronising voxels to main memory.
+  auto *gpu_map = gpuMap();
+  if (gpu_map && gpu_map->gpuCache())
+  {
+    gpu_map->gpuCache()->gpuQueue().finish();
+  }
+  Super::syncBatch();
+}
+
+
 void OhmAppGpu::finaliseMap()
 {
   if (auto *gpu_map = gpuMap())
   {
     logutil::info("syncing GPU voxels\n");
-    gpu_map->syncVoxels();
+    if (auto *hybrid_map = dynamic_cast<ohm::GpuHybridMap *>(true_mapper_.get()))
+    {
+      logutil::info("GPU hybrid CPU share: ", hybrid_map->cpuShare(), '\n');
+      hybrid_map->syncVoxels();
+    }
+    else
+    {
+      gpu_map->syncVoxels();
+    }
+    if (auto *secondary_sample_map = dynamic_cast<ohm::GpuMap *>(secondary_sample_mapper_.get()))
+    {
+      secondary_sample_map->syncVoxels();
+    }
+
+    gputil::Profiler *profiler = (gpu_map->gpuCache()) ? gpu_map->gpuCache()->profiler() : nullptr;
+    if (profiler)
+    {
+      logGpuProfile(*profiler);
+    }
   }
   Super::finaliseMap();
 }
@@ -35,6 +35,17 @@ public:
     double ray_segment_length = 0;
     /// Trace rays forwards. GPU defaults to reverse ray tracing for performance.
     bool forward_trace = false;
+    /// Aggregate same voxel updates on GPU. See @c ohm::GpuMap::setAggregateUpdates() .
+    bool aggregate_updates = false;
+    /// Use a dedicated GPU queue for region uploads and downloads. See @c ohm::gpumap::kGpuTransferQueue .
+    bool transfer_queue = false;
+    /// Profile GPU kernels and transfers, reporting device timing on completion. See @c ohm::gpumap::kGpuProfile .
+    bool profile = false;
+    /// Split occupancy ray integration between the GPU and CPU threads. See @c ohm::GpuHybridMap .
+    bool hybrid = false;
+    /// Initial fraction of the map regions integrated on CPU when @c hybrid is set. See
+    /// @c ohm::GpuHybridMap::setCpuShare() .
+    float hybrid_cpu_share = 0.25f;  // NOLINT(readability-magic-numbers)
 
     GpuOptions();
 
@@ -94,6 +105,7 @@ protected:
   OhmAppGpu(std::unique_ptr<Options> &&options, std::shared_ptr<ohmapp::DataSource> data_source);
 
   int prepareForRun() override;
+  void syncBatch() override;
   void finaliseMap() override;
 };
 }  // namespace ohmapp
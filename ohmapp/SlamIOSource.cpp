@@ -7,6 +7,7 @@
 
 #include <logutil/Logger.h>
 
+#include <slamio/RayCloudWriter.h>
 #include <slamio/SlamCloudLoader.h>
 
 #include <glm/glm.hpp>
@@ -30,6 +31,7 @@ void SlamIOSource::Options::configure(cxxopts::OptionAdder &adder)
     ("cloud", "The input cloud (las/laz) to load.", cxxopts::value(cloud_file))
     ("points-only", "Assume the point cloud is providing points only. Otherwise a cloud file with no trajectory is considered a ray cloud.", optVal(point_cloud_only))
     ("preload", "Preload this number of points before starting processing. -1 for all. May be used for separating processing and loading time.", optVal(preload_count)->default_value("0")->implicit_value("-1"))
+    ("save-rays", "Write the loaded rays to this binary ray cloud file (.rcb) for faster replay. The file may be given as the --cloud for subsequent runs.", cxxopts::value(save_rays_file))
     ("sensor", "Offset from the trajectory to the sensor position. Helps correct trajectory to the sensor centre for better rays.", optVal(sensor_offset))
     ("trajectory", "The trajectory (text) file to load.", cxxopts::value(trajectory_file))
     ;
@@ -70,6 +72,11 @@ void SlamIOSource::Options::print(std::ostream &out)
     out << '\n';
   }
 
+  if (!save_rays_file.empty())
+  {
+    out << "Save rays: " << save_rays_file << '\n';
+  }
+
   if (sensor_batch_delta >= 0)
   {
     out << "Sensor batch delta: " << sensor_batch_delta << '\n';
@@ -126,6 +133,12 @@ void SlamIOSource::requestBatchSettings(unsigned batch_size, double max_sensor_m
 }
 
 
+void SlamIOSource::updateBatchSize(unsigned batch_size)
+{
+  options().batch_size = batch_size;
+}
+
+
 int SlamIOSource::validateOptions()
 {
   if (options().cloud_file.empty())
@@ -142,6 +155,8 @@ int SlamIOSource::prepareForRun(uint64_t &point_count, const std::string &refere
 {
   loader_ = std::make_unique<slamio::SlamCloudLoader>();
   loader_->enableReturnNumberInference(options().return_number_mode == ReturnNumberMode::Auto);
+  // Decode and trajectory interpolation run on background threads.
+  loader_->enablePipeline(true);
 
   loader_->setErrorLog([this](const char *msg) { logutil::error(msg); });
   if (!options().trajectory_file.empty())
@@ -211,6 +226,17 @@ int SlamIOSource::prepareForRun(uint64_t &point_count, const std::string &refere
     Stats::writeCsvHeader(*stats_csv_);
   }
 
+  if (!options().save_rays_file.empty())
+  {
+    ray_writer_ = std::make_unique<slamio::RayCloudWriter>();
+    if (!ray_writer_->open(options().save_rays_file.c_str()))
+    {
+      logutil::error("Unable to open ray cloud file for writing ", options().save_rays_file, '\n');
+      ray_writer_.reset();
+      return 1;
+    }
+  }
+
   return 0;
 }
 
@@ -223,6 +249,14 @@ int SlamIOSource::run(BatchFunction batch_function, unsigned *quit_level_ptr)
       stats_csv_->flush();
       stats_csv_.reset();
     };
+    if (ray_writer_)
+    {
+      if (!ray_writer_->close())
+      {
+        logutil::error("Error writing ray cloud file ", options().save_rays_file, '\n');
+      }
+      ray_writer_.reset();
+    }
   };
 
   time_point_start_ = Clock::now();
@@ -241,7 +275,7 @@ int SlamIOSource::run(BatchFunction batch_function, unsigned *quit_level_ptr)
   glm::dvec3 batch_origin(0);
   glm::dvec3 last_batch_origin(0);
   // Update map visualisation every N samples.
-  const size_t ray_batch_size = options().batch_size;
+  size_t ray_batch_size = options().batch_size;
   double timebase = -1;
   double last_batch_timestamp = -1;
   double accumulated_motion = 0;
@@ -337,6 +371,8 @@ int SlamIOSource::run(BatchFunction batch_function, unsigned *quit_level_ptr)
     {
       finish = !processBatch(batch_function, batch_origin, sensor_and_samples, timestamps, intensities, colours,
                              return_numbers, batch_stats);
+      // The batch function may change the batch size - see updateBatchSize().
+      ray_batch_size = options().batch_size;
 
       delta_motion = glm::length(batch_origin - last_batch_origin);
       accumulated_motion += delta_motion;
@@ -465,6 +501,17 @@ inline bool SlamIOSource::processBatch(const BatchFunction &batch_function, cons
   stats.process_time_end = std::chrono::duration<double>(time_now - time_point_start_).count();
   stats.data_time_end = (!timestamps.empty()) ? timestamps.back() : stats.data_time_start;
   stats.ray_count = unsigned(timestamps.size());
+  if (ray_writer_)
+  {
+    const bool rays = !samplesOnly();
+    for (size_t i = 0; i < timestamps.size(); ++i)
+    {
+      const glm::dvec3 &sample = (rays) ? sensor_and_samples[i * 2 + 1] : sensor_and_samples[i];
+      const glm::dvec3 &origin = (rays) ? sensor_and_samples[i * 2] : sample;
+      ray_writer_->addRay(origin, sample, timestamps[i], (i < intensities.size()) ? intensities[i] : 0.0f,
+                          (i < return_number.size()) ? return_number[i] : 0u);
+    }
+  }
   const bool keep_processing =
     batch_function(batch_origin, sensor_and_samples, timestamps, intensities, colours, return_number);
   if (options().stats_mode != StatsMode::Off)
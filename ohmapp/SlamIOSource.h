@@ -16,6 +16,7 @@
 
 namespace slamio
 {
+class RayCloudWriter;
 class SlamCloudLoader;
 }
 
@@ -47,6 +48,9 @@ public:
     /// True to process a point cloud without a trajectory. No sensor positions are known, and the sensor positions are
     /// given as the sample positions.
     bool point_cloud_only = false;
+    /// Optional binary ray cloud file (.rcb) to write the loaded rays to. Supports faster replay of the same data. See
+    /// @c slamio::RayCloudWriter .
+    std::string save_rays_file;
 
     void configure(cxxopts::OptionAdder &adder) override;
     void print(std::ostream &out) override;
@@ -69,6 +73,7 @@ public:
   double processedTimeRange() const override;
   unsigned expectedBatchSize() const override;
   void requestBatchSettings(unsigned batch_size, double max_sensor_motion) override;
+  void updateBatchSize(unsigned batch_size) override;
 
   int validateOptions() override;
   int prepareForRun(uint64_t &point_count, const std::string &reference_name) override;
@@ -97,6 +102,8 @@ private:
 
   /// Slam cloud loader. Valid after calling @c createSlamLoader() as called from @c run() .
   std::unique_ptr<slamio::SlamCloudLoader> loader_;
+  /// Binary ray cloud writer. Valid during @c run() when @c Options::save_rays_file is set.
+  std::unique_ptr<slamio::RayCloudWriter> ray_writer_;
   /// Number of points processed. Must be kept up to date during @c run() for display and statistics.
   std::atomic<uint64_t> processed_point_count_{};
   /// Time range processed. Must be kept up to date during @c run() for display and statistics.
@@ -19,6 +19,7 @@
 #include <ohm/OccupancyMap.h>
 #include <ohm/OccupancyUtil.h>
 #include <ohm/QueryFlag.h>
+#include <ohm/TaskArena.h>
 #include <ohm/VoxelData.h>
 
 #include <ohm/private/MapLayoutDetail.h>
@@ -42,6 +43,7 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #define VALIDATE_VALUES_UNCHANGED 0
 
@@ -212,7 +214,9 @@ void regionFloodFillStepCpuBlock(OccupancyMap &map, ClearanceProcessDetail & /*q
     }
   }
 
-  chunk->touched_stamps[map.layout().clearanceLayer()] = chunk->dirty_stamp = map.touch();
+  const uint64_t stamp = map.touch();
+  chunk->touched_stamps[map.layout().clearanceLayer()] = stamp;
+  chunk->markDirty(stamp);
 }
 
 
@@ -239,10 +243,12 @@ unsigned regionClearanceProcessCpu(OccupancyMap &map, ClearanceProcessDetail &qu
                                    glm::ivec3(range.cols().end(), range.rows().end(), range.pages().end()), region_key,
                                    chunk, voxel_search_half_extents);
   };
-  tbb::parallel_for(
-    tbb::blocked_range3d<int>(0, map_data.region_voxel_dimensions.z, 0, map_data.region_voxel_dimensions.y, 0,
-                              map_data.region_voxel_dimensions.x),
-    parallel_query_func);
+  parallelExecute([&]() {
+    tbb::parallel_for(
+      tbb::blocked_range3d<int>(0, map_data.region_voxel_dimensions.z, 0, map_data.region_voxel_dimensions.y, 0,
+                                map_data.region_voxel_dimensions.x),
+      parallel_query_func);
+  });
 
 #else   // OHM_FEATURE_THREADS
   regionClearanceProcessCpuBlock(map, query, glm::ivec3(0, 0, 0), map_data.region_voxel_dimensions, region_key, chunk,
@@ -276,10 +282,12 @@ unsigned regionSeedFloodFillCpu(OccupancyMap &map, ClearanceProcessDetail &query
                                 glm::ivec3(range.cols().end(), range.rows().end(), range.pages().end()), region_key,
                                 chunk, voxel_search_half_extents);
   };
-  tbb::parallel_for(
-    tbb::blocked_range3d<int>(0, map_data.region_voxel_dimensions.z, 0, map_data.region_voxel_dimensions.y, 0,
-                              map_data.region_voxel_dimensions.x),
-    parallel_query_func);
+  parallelExecute([&]() {
+    tbb::parallel_for(
+      tbb::blocked_range3d<int>(0, map_data.region_voxel_dimensions.z, 0, map_data.region_voxel_dimensions.y, 0,
+                                map_data.region_voxel_dimensions.x),
+      parallel_query_func);
+  });
 
 #else   // OHM_FEATURE_THREADS
   regionSeedFloodFillCpuBlock(map, query, glm::ivec3(0, 0, 0), map_data.region_voxel_dimensions, region_key, chunk,
@@ -313,10 +321,12 @@ unsigned regionFloodFillStepCpu(OccupancyMap &map, ClearanceProcessDetail &query
                                 glm::ivec3(range.cols().end(), range.rows().end(), range.pages().end()), region_key,
                                 chunk, voxel_search_half_extents);
   };
-  tbb::parallel_for(
-    tbb::blocked_range3d<int>(0, map_data.region_voxel_dimensions.z, 0, map_data.region_voxel_dimensions.y, 0,
-                              map_data.region_voxel_dimensions.x),
-    parallel_query_func);
+  parallelExecute([&]() {
+    tbb::parallel_for(
+      tbb::blocked_range3d<int>(0, map_data.region_voxel_dimensions.z, 0, map_data.region_voxel_dimensions.y, 0,
+                                map_data.region_voxel_dimensions.x),
+      parallel_query_func);
+  });
 
 #else   // OHM_FEATURE_THREADS
   regionFloodFillStepCpuBlock(map, query, glm::ivec3(0, 0, 0), map_data.region_voxel_dimensions, region_key, chunk,
@@ -325,14 +335,51 @@ unsigned regionFloodFillStepCpu(OccupancyMap &map, ClearanceProcessDetail &query
 
   return calc_extents.x * calc_extents.y * calc_extents.z;
 }
+
+
+/// Check whether the clearance values for @p region are out of date.
+///
+/// We are dirty if any input region has updated occupancy values since the last
+/// region->touchedStamps[clearance_layer_index] value. We iterate to work out the maximum
+/// touchedStamps[occupancy_layer_index] value in the neighbourhood and compare that to our region
+/// clearance_layer_index stamp. Dirty if clearance stamp is lower. The target value also sets the new stamp to apply
+/// to the region clearance stamp.
+bool clearanceUpdateRequired(OccupancyMap &map, const MapChunk &region, const glm::i16vec3 &region_key, bool force,
+                             uint64_t *target_update_stamp)
+{
+  const int occupancy_layer_index = map.layout().occupancyLayer();
+  const int clearance_layer_index = map.layout().clearanceLayer();
+
+  // Explore the region neighbours to see if they are out of date. That would invalidate this region.
+  glm::i16vec3 neighbour_key;
+  *target_update_stamp = region.touched_stamps[occupancy_layer_index];
+  for (int z = -1; z <= 1; ++z)
+  {
+    neighbour_key.z = region_key.z + z;
+    for (int y = -1; y <= 1; ++y)
+    {
+      neighbour_key.y = region_key.y + y;
+      for (int x = -1; x <= 1; ++x)
+      {
+        neighbour_key.x = region_key.x + x;
+        MapChunk *neighbour = map.region(neighbour_key, false);
+        if (neighbour)
+        {
+          *target_update_stamp =
+            std::max(*target_update_stamp, uint64_t(neighbour->touched_stamps[occupancy_layer_index]));
+        }
+      }
+    }
+  }
+
+  return force || region.touched_stamps[clearance_layer_index] < *target_update_stamp;
+}
 }  // namespace
 
 
 ClearanceProcess::ClearanceProcess()
   : imp_(new ClearanceProcessDetail)
-{
-  imp_->gpu_query = std::make_unique<RoiRangeFill>(gpuDevice());
-}
+{}
 
 
 ClearanceProcess::ClearanceProcess(float search_radius, unsigned query_flags)
@@ -414,12 +461,64 @@ void ClearanceProcess::ensureClearanceLayer(OccupancyMap &map)
 }
 
 
+void ClearanceProcess::ensureClearanceChannelsLayer(OccupancyMap &map)
+{
+  if (map.layout().layerIndex(default_layer::clearanceChannelsLayerName()) != -1)
+  {
+    return;
+  }
+
+  MapLayout updated_layout(map.layout());
+  addClearanceChannels(updated_layout);
+  map.updateLayout(updated_layout, true);
+}
+
+
+bool ClearanceProcess::layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                                         std::vector<int> &write_layers) const
+{
+  const ClearanceProcessDetail *d = imp();
+  if ((d->query_flags & kQfGpuEvaluate) || layout.occupancyLayer() < 0 || layout.clearanceLayer() < 0)
+  {
+    return false;
+  }
+
+  read_layers.emplace_back(layout.occupancyLayer());
+  write_layers.emplace_back(layout.clearanceLayer());
+  if (d->query_flags & kQfClearanceChannels)
+  {
+    const int channels_layer = layout.layerIndex(default_layer::clearanceChannelsLayerName());
+    if (channels_layer < 0)
+    {
+      return false;
+    }
+    write_layers.emplace_back(channels_layer);
+  }
+  return true;
+}
+
+
+void ClearanceProcess::prepareUpdate(OccupancyMap &map)
+{
+  const ClearanceProcessDetail *d = imp();
+  ensureClearanceLayer(map);
+  if (d->query_flags & kQfClearanceChannels)
+  {
+    ensureClearanceChannelsLayer(map);
+  }
+}
+
+
 int ClearanceProcess::update(OccupancyMap &map, double time_slice)
 {
   ClearanceProcessDetail *d = imp();
 
   // Ensure clearnce layer is present.
   ensureClearanceLayer(map);
+  if (d->query_flags & kQfClearanceChannels)
+  {
+    ensureClearanceChannelsLayer(map);
+  }
 
   using Clock = std::chrono::high_resolution_clock;
   const auto start_time = Clock::now();
@@ -440,6 +539,11 @@ int ClearanceProcess::update(OccupancyMap &map, double time_slice)
     clearance_cache->clear();
   }
 
+  if (hasReferencePosition())
+  {
+    return updatePrioritised(map, time_slice);
+  }
+
   if (!d->haveWork())
   {
     d->getWork(map);
@@ -449,14 +553,31 @@ int ClearanceProcess::update(OccupancyMap &map, double time_slice)
 
   unsigned total_processed = 0;
   const glm::i16vec3 step(1);
+  std::vector<glm::i16vec3> batch_keys;
   while (d->haveWork() && (time_slice <= 0 || elapsed_sec < time_slice))
   {
-    // Iterate dirty regions
-    updateRegion(map, d->current_dirty_cursor, false);
-    // updateExtendedRegion(map, d->mapStamp, d->currentDirtyCursor, d->currentDirtyCursor + step - glm::i16vec3(1));
-    d->stepCursor(step);
+    if ((d->query_flags & kQfGpuEvaluate))
+    {
+      // Collect a run of dirty regions to calculate in a single GPU batch.
+      batch_keys.clear();
+      while (d->haveWork() && batch_keys.size() < d->gpu_batch_size)
+      {
+        batch_keys.emplace_back(d->current_dirty_cursor);
+        d->stepCursor(step);
+      }
+      updateRegions(map, batch_keys, false);
+      total_processed += unsigned(batch_keys.size()) * volumeOf(step);
+    }
+    else
+    {
+      // Iterate dirty regions
+      updateRegion(map, d->current_dirty_cursor, false);
+      // updateExtendedRegion(map, d->mapStamp, d->currentDirtyCursor, d->currentDirtyCursor + step -
+      // glm::i16vec3(1));
+      d->stepCursor(step);
 
-    total_processed += volumeOf(step);
+      total_processed += volumeOf(step);
+    }
 
     if (!d->haveWork())
     {
@@ -471,11 +592,70 @@ int ClearanceProcess::update(OccupancyMap &map, double time_slice)
 }
 
 
+int ClearanceProcess::updatePrioritised(OccupancyMap &map, double time_slice)
+{
+  ClearanceProcessDetail *d = imp();
+
+  using Clock = std::chrono::high_resolution_clock;
+  const auto start_time = Clock::now();
+  double elapsed_sec = 0;
+
+  // Queue newly dirty regions along with their neighbours, which are affected by the flooding effect of the update.
+  // Regions already queued retain their staleness.
+  d->scheduler.setReferencePosition(referencePosition());
+  d->scheduler.pushDirtyRegions(map, map.layout().occupancyLayer(), map.layout().clearanceLayer(), 1);
+
+  unsigned total_processed = 0;
+  glm::i16vec3 region_key;
+  std::vector<glm::i16vec3> batch_keys;
+  while ((time_slice <= 0 || elapsed_sec < time_slice) && d->scheduler.pop(map, &region_key))
+  {
+    if ((d->query_flags & kQfGpuEvaluate))
+    {
+      // Calculate the highest priority regions in a single GPU batch.
+      batch_keys.clear();
+      batch_keys.emplace_back(region_key);
+      while (batch_keys.size() < d->gpu_batch_size && d->scheduler.pop(map, &region_key))
+      {
+        batch_keys.emplace_back(region_key);
+      }
+      total_processed += updateRegions(map, batch_keys, false);
+    }
+    else
+    {
+      total_processed += (updateRegion(map, region_key, false)) ? 1 : 0;
+    }
+    const auto cur_time = Clock::now();
+    elapsed_sec = std::chrono::duration_cast<std::chrono::duration<double>>(cur_time - start_time).count();
+  }
+
+  return (total_processed != 0 || !d->scheduler.empty()) ? kMprProgressing : kMprUpToDate;
+}
+
+
+RegionScheduler &ClearanceProcess::scheduler()
+{
+  ClearanceProcessDetail *d = imp();
+  return d->scheduler;
+}
+
+
+const RegionScheduler &ClearanceProcess::scheduler() const
+{
+  const ClearanceProcessDetail *d = imp();
+  return d->scheduler;
+}
+
+
 void ohm::ClearanceProcess::calculateForExtents(OccupancyMap &map, const glm::dvec3 &min_extents,
                                                 const glm::dvec3 &max_extents, bool force)
 {
   // Ensure clearnce layer is present.
   ensureClearanceLayer(map);
+  if (imp()->query_flags & kQfClearanceChannels)
+  {
+    ensureClearanceChannelsLayer(map);
+  }
 
   const glm::i16vec3 min_region = map.regionKey(min_extents);
   const glm::i16vec3 max_region = map.regionKey(max_extents);
@@ -494,6 +674,7 @@ void ohm::ClearanceProcess::calculateForExtents(OccupancyMap &map, const glm::dv
     clearance_cache->clear();
   }
 
+  std::vector<glm::i16vec3> region_keys;
   for (int z = min_region.z; z <= max_region.z; ++z)
   {
     region_key.z = z;
@@ -503,12 +684,15 @@ void ohm::ClearanceProcess::calculateForExtents(OccupancyMap &map, const glm::dv
       for (int x = min_region.x; x <= max_region.x; ++x)
       {
         region_key.x = x;
-        updateRegion(map, region_key, force);
+        region_keys.emplace_back(region_key);
       }
     }
   }
+
+  updateRegions(map, region_keys, force);
 }
 
+
 bool ClearanceProcess::updateRegion(OccupancyMap &map, const glm::i16vec3 &region_key, bool force)
 {
   // Get the next region.
@@ -528,35 +712,8 @@ bool ClearanceProcess::updateRegion(OccupancyMap &map, const glm::i16vec3 &regio
     return false;
   }
 
-  // Explore the region neighbours to see if they are out of date. That would invalidate this region.
-  glm::i16vec3 neighbour_key;
-
-  // We are dirty if any input region has updated occupancy values since the last
-  // region->touchedStamps[clearance_layer_index] value. We iterate to work out the maximum
-  // touchedStamps[occupancy_layer_index] value in the neighbourhood and compare that to our region
-  // clearance_layer_index stamp. Dirty if clearance stamp is lower. The target value also sets the new stamp to apply
-  // to the region clearance stamp.
-  uint64_t target_update_stamp = region->touched_stamps[occupancy_layer_index];
-  for (int z = -1; z <= 1; ++z)
-  {
-    neighbour_key.z = region_key.z + z;
-    for (int y = -1; y <= 1; ++y)
-    {
-      neighbour_key.y = region_key.y + y;
-      for (int x = -1; x <= 1; ++x)
-      {
-        neighbour_key.x = region_key.x + x;
-        MapChunk *neighbour = map.region(neighbour_key, false);
-        if (neighbour)
-        {
-          target_update_stamp =
-            std::max(target_update_stamp, uint64_t(neighbour->touched_stamps[occupancy_layer_index]));
-        }
-      }
-    }
-  }
-
-  if (!force && region->touched_stamps[clearance_layer_index] >= target_update_stamp)
+  uint64_t target_update_stamp = 0;
+  if (!clearanceUpdateRequired(map, *region, region_key, force, &target_update_stamp))
   {
     // Nothing to update in these extents.
     return false;
@@ -570,11 +727,29 @@ bool ClearanceProcess::updateRegion(OccupancyMap &map, const glm::i16vec3 &regio
   if ((d->query_flags & kQfGpuEvaluate))
   {
     PROFILE(occupancyClearanceProcessGpu);
+    if (!d->gpu_query)
+    {
+      d->gpu_query = std::make_unique<RoiRangeFill>(gpuDevice());
+    }
     d->gpu_query->setAxisScaling(d->axis_scaling);
     d->gpu_query->setSearchRadius(d->search_radius);
     d->gpu_query->setQueryFlags(d->query_flags);
+    d->gpu_query->setCalculateChannels((d->query_flags & kQfClearanceChannels) != 0);
     d->gpu_query->calculateForRegion(map, region_key);
   }
+  else if ((d->query_flags & kQfCpuRoiRangeFill))
+  {
+    PROFILE(occupancyClearanceProcessCpuRoi);
+    if (!d->cpu_query)
+    {
+      d->cpu_query = std::make_unique<RoiRangeFillCpu>();
+    }
+    d->cpu_query->setAxisScaling(d->axis_scaling);
+    d->cpu_query->setSearchRadius(d->search_radius);
+    d->cpu_query->setQueryFlags(d->query_flags);
+    d->cpu_query->setCalculateChannels((d->query_flags & kQfClearanceChannels) != 0);
+    d->cpu_query->calculateForRegion(map, region_key);
+  }
   else
   {
     std::function<unsigned(OccupancyMap &, ClearanceProcessDetail &, const glm::i16vec3 &, ClosestResult &)> query_func;
@@ -611,6 +786,19 @@ bool ClearanceProcess::updateRegion(OccupancyMap &map, const glm::i16vec3 &regio
                                  d->maxExtents + glm::dvec3(d->searchRadius), queryFunc);
     }
 #endif  // #
+
+    if ((d->query_flags & kQfClearanceChannels))
+    {
+      // The brute force search has no channel support. Use the ROI range fill channels.
+      if (!d->cpu_query)
+      {
+        d->cpu_query = std::make_unique<RoiRangeFillCpu>();
+      }
+      d->cpu_query->setAxisScaling(d->axis_scaling);
+      d->cpu_query->setSearchRadius(d->search_radius);
+      d->cpu_query->setQueryFlags(d->query_flags);
+      d->cpu_query->calculateChannelsForRegion(map, region_key);
+    }
   }
 
   TES_SERVER_UPDATE(g_tes, 0.0f);
@@ -624,6 +812,70 @@ bool ClearanceProcess::updateRegion(OccupancyMap &map, const glm::i16vec3 &regio
 }
 
 
+unsigned ClearanceProcess::updateRegions(OccupancyMap &map, const std::vector<glm::i16vec3> &region_keys, bool force)
+{
+  ClearanceProcessDetail *d = imp();
+
+  if (!(d->query_flags & kQfGpuEvaluate))
+  {
+    unsigned updated_count = 0;
+    for (const auto &region_key : region_keys)
+    {
+      updated_count += (updateRegion(map, region_key, force)) ? 1 : 0;
+    }
+    return updated_count;
+  }
+
+  const int occupancy_layer_index = map.layout().occupancyLayer();
+  const int clearance_layer_index = map.layout().clearanceLayer();
+
+  if (occupancy_layer_index < 0 || clearance_layer_index < 0)
+  {
+    return 0;
+  }
+
+  // Filter the regions which need to be updated.
+  std::vector<glm::i16vec3> dirty_keys;
+  std::vector<MapChunk *> dirty_regions;
+  std::vector<uint64_t> target_update_stamps;
+  for (const auto &region_key : region_keys)
+  {
+    MapChunk *region = map.region(region_key, (d->query_flags & kQfInstantiateUnknown));
+    uint64_t target_update_stamp = 0;
+    if (region && clearanceUpdateRequired(map, *region, region_key, force, &target_update_stamp))
+    {
+      dirty_keys.emplace_back(region_key);
+      dirty_regions.emplace_back(region);
+      target_update_stamps.emplace_back(target_update_stamp);
+    }
+  }
+
+  if (dirty_keys.empty())
+  {
+    return 0;
+  }
+
+  PROFILE(occupancyClearanceProcessGpuBatch);
+  if (!d->gpu_query)
+  {
+    d->gpu_query = std::make_unique<RoiRangeFill>(gpuDevice());
+  }
+  d->gpu_query->setAxisScaling(d->axis_scaling);
+  d->gpu_query->setSearchRadius(d->search_radius);
+  d->gpu_query->setQueryFlags(d->query_flags);
+  d->gpu_query->setCalculateChannels((d->query_flags & kQfClearanceChannels) != 0);
+  d->gpu_query->calculateForRegions(map, dirty_keys.data(), dirty_keys.size());
+
+  // Regions are up to date *now*.
+  for (size_t i = 0; i < dirty_regions.size(); ++i)
+  {
+    dirty_regions[i]->touched_stamps[clearance_layer_index] = target_update_stamps[i];
+  }
+
+  return unsigned(dirty_keys.size());
+}
+
+
 ClearanceProcessDetail *ClearanceProcess::imp()
 {
   return static_cast<ClearanceProcessDetail *>(imp_);
@@ -13,10 +13,13 @@
 
 #include <glm/fwd.hpp>
 
+#include <vector>
+
 namespace ohm
 {
 struct ClearanceProcessDetail;
 class OccupancyMap;
+class RegionScheduler;
 
 /// This query calculates the @c Voxel::clearance() for all voxels within the query extents.
 ///
@@ -35,6 +38,14 @@ class OccupancyMap;
 /// implementation is closer to worst case O(m) although it incurs additional, initial overhead. The GPU
 /// implementation is recommended over the CPU implementation.
 ///
+/// The GPU implementation calculates dirty regions in batches. Neighbouring dirty regions are processed as a single
+/// block, uploading the padding regions required to reach the @c searchRadius() once per block rather than once per
+/// region.
+///
+/// The @c kQfCpuRoiRangeFill flag selects a CPU implementation of the GPU algorithm instead of the brute force search.
+/// This uses @c RoiRangeFillCpu , which is multi-threaded when @c OHM_FEATURE_THREADS is enabled and requires no GPU
+/// device. It is recommended where no GPU is available.
+///
 /// Both CPU and GPU implementations keep track of which regions have been previously calculated. Results are not
 /// recalculated for a region unless a hard @c reset() is performed.
 ///
@@ -47,6 +58,11 @@ class OccupancyMap;
 /// - > 0 => There is an obstructed voxel within the @c searchRadius().
 /// - < 0 => There are no obstructions within the @c searchRadius().
 ///
+/// With @c kQfClearanceChannels , the @c VoxelClearanceChannels are also calculated for each region: the range to
+/// the nearest obstruction in the voxel's XY plane and the height to the nearest obstruction directly above the voxel.
+/// These support ground robot footprints, which must treat overhead and horizontal obstacles differently. On GPU the
+/// channels are propagated in the same pass as the clearance values.
+///
 /// This query respects the @c QF_UnknownAsOccupied flag, allowing unknown obstacles to be considered as obstacles.
 ///
 /// Note that for this @c Query the following methods are invalid, have different semantics or
@@ -67,6 +83,12 @@ public:
   {
     /// Instantiate regions which are in unknown space.
     kQfInstantiateUnknown = (kQfSpecialised << 0u),
+    /// Use the multi-threaded CPU ROI range fill algorithm (@c RoiRangeFillCpu ) rather than the brute force CPU
+    /// implementation. Ignored when @c kQfGpuEvaluate is set.
+    kQfCpuRoiRangeFill = (kQfSpecialised << 1u),
+    /// Also calculate the directional @c VoxelClearanceChannels - horizontal and overhead clearance - into the layer
+    /// named @c default_layer::clearanceChannelsLayerName() . The layer is added as required.
+    kQfClearanceChannels = (kQfSpecialised << 2u),
   };
 
   /// Empty constructor.
@@ -74,7 +96,7 @@ public:
 
   /// Construct a new query using the given parameters.
   ///
-  /// This constructor will instantiate a GPU cache in order to aid in the query.
+  /// This constructor will instantiate a GPU cache in order to aid in the query when @c kQfGpuEvaluate is set.
   ///
   /// @param search_radius Defines the search radius around @p nearPoint.
   /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag and @c ClearanceProcess::QueryFlag.
@@ -140,7 +162,37 @@ public:
   /// @param map The map to ensure has a clearance layer.
   static void ensureClearanceLayer(OccupancyMap &map);
 
+  /// Ensure the @c VoxelClearanceChannels layer is present in @p map . See @c kQfClearanceChannels .
+  /// @param map The map to ensure has a clearance channels layer.
+  static void ensureClearanceChannelsLayer(OccupancyMap &map);
+
+  /// Declares the occupancy layer as read and the clearance layer - and clearance channels layer - as written. No
+  /// dependencies are declared when @c kQfGpuEvaluate is set as the GPU cache cannot be shared between concurrent
+  /// processes.
+  /// @param layout The map layout.
+  /// @param[out] read_layers Populated with the occupancy layer index.
+  /// @param[out] write_layers Populated with the clearance layer index.
+  /// @return True when the layers are present and the process may run concurrently.
+  bool layerDependencies(const MapLayout &layout, std::vector<int> &read_layers,
+                         std::vector<int> &write_layers) const override;
+
+  /// Ensures the clearance layer is present.
+  /// @param map The map to be updated.
+  void prepareUpdate(OccupancyMap &map) override;
+
+  /// Access the @c RegionScheduler used to prioritise updates when a @c referencePosition() is set. This may be used
+  /// to configure the @c RegionScheduler::priorityRadius() and @c RegionScheduler::stalenessWeight() .
+  /// @return The region scheduler.
+  RegionScheduler &scheduler();
+  /// @overload
+  const RegionScheduler &scheduler() const;
+
   /// Update the processing queue to process part of the dirty list.
+  ///
+  /// When a @c referencePosition() is set, dirty regions are processed in order of priority - nearest the reference
+  /// position and stalest first - using the @c scheduler() . Otherwise dirty regions are processed in order within the
+  /// dirty extents.
+  ///
   /// @param map The map to process.
   /// @param time_slice The amount of time available for processing (seconds). Stop if exceeded.
   /// @return See @c MappingProcessResult.
@@ -169,6 +221,23 @@ protected:
   /// @return True if work was done. False if nothing need be done.
   bool updateRegion(OccupancyMap &map, const glm::i16vec3 &region_key, bool force);
 
+  /// Update clearance for a set of regions.
+  ///
+  /// With @c kQfGpuEvaluate , the regions requiring an update are calculated together by @c RoiRangeFill , which
+  /// processes blocks of neighbouring regions in a single dispatch, sharing the padding regions between them. Otherwise
+  /// this is equivalent to calling @c updateRegion() for each region.
+  /// @param map The operating map.
+  /// @param region_keys The keys of the regions to update.
+  /// @param force Force update => update even if not dirty.
+  /// @return The number of regions updated.
+  unsigned updateRegions(OccupancyMap &map, const std::vector<glm::i16vec3> &region_keys, bool force);
+
+  /// Implementation of @c update() when a @c referencePosition() is set, processing regions in @c scheduler() order.
+  /// @param map The map to process.
+  /// @param time_slice The amount of time available for processing (seconds). Stop if exceeded.
+  /// @return See @c MappingProcessResult.
+  int updatePrioritised(OccupancyMap &map, double time_slice);
+
   /// Internal data access
   /// @return The internal data members.
   ClearanceProcessDetail *imp();
@@ -7,17 +7,24 @@
 
 #include "GpuLayerCache.h"
 #include "GpuLayerCacheParams.h"
+#include "GpuMap.h"
+#include "GpuMemoryArbiter.h"
 
 #include "OhmGpu.h"
 
 #include "private/GpuMapDetail.h"
 
 #include <ohm/MapChunk.h>
+#include <ohm/MapMemoryAccounting.h>
+#include <ohm/OccupancyMap.h>
 #include <ohm/VoxelBlock.h>
 #include <ohm/VoxelBuffer.h>
 
 #include <gputil/gpuDevice.h>
+#include <gputil/gpuProfiler.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -30,30 +37,98 @@ constexpr size_t GpuCache::kDefaultLayerMemSize;
 constexpr size_t GpuCache::kDefaultTargetMemSize;
 
 
+namespace
+{
+/// The minimum GPU memory budget for a @c GpuCache is the requested size divided by this value.
+const size_t kMinBudgetDivisor = 4u;
+}  // namespace
+
 struct GpuCacheDetail
 {
   std::vector<std::unique_ptr<GpuLayerCache>> layer_caches;
+  /// Fraction of the @c target_gpu_alloc_size used by each of the @c layer_caches when created.
+  std::vector<double> layer_mem_fractions;
   gputil::Device gpu;
   gputil::Queue gpu_queue;
+  /// Separate queue for @c GpuCache::prefetch() copies. Created on first use.
+  gputil::Queue prefetch_queue;
+  /// Layer cache upload and download queue. Only valid with @c gpumap::kGpuTransferQueue .
+  gputil::Queue transfer_queue;
+  /// Device timing for the cache and @c GpuMap commands. Only valid with @c gpumap::kGpuProfile .
+  std::unique_ptr<gputil::Profiler> profiler;
   OccupancyMap *map = nullptr;
+  /// Registration with the @c GpuMemoryArbiter .
+  GpuMemoryConsumer memory_consumer;
+  /// Latest budget from the @c GpuMemoryArbiter yet to be applied. Zero when there is no change. Shared with the
+  /// eviction function, which may be invoked from other threads.
+  std::shared_ptr<std::atomic<size_t>> pending_budget = std::make_shared<std::atomic<size_t>>(0u);
   size_t target_gpu_alloc_size = 0;
+  size_t requested_gpu_alloc_size = 0;
   unsigned flags = 0;
+  GpuLayerCacheEviction eviction_policy = kGceLru;
+
+  void reportMemoryUsage()
+  {
+    size_t used = 0;
+    std::vector<size_t> layer_used;
+    for (auto &&layer : layer_caches)
+    {
+      if (layer)
+      {
+        const size_t layer_bytes = size_t(layer->cacheSize()) * size_t(layer->chunkSize());
+        used += layer_bytes;
+        layer_used.resize(std::max<size_t>(layer_used.size(), layer->layerIndex() + 1u), 0u);
+        layer_used[layer->layerIndex()] += layer_bytes;
+      }
+    }
+    memory_consumer.reportUsage(used);
+    map->memoryAccounting().setGpuBytes(layer_used);
+  }
 };
 
 
 GpuCache::GpuCache(OccupancyMap &map, size_t target_gpu_alloc_size, unsigned flags)
+  : GpuCache(map, ohm::gpuDevice(), target_gpu_alloc_size, flags)
+{}
+
+
+GpuCache::GpuCache(OccupancyMap &map, const gputil::Device &gpu, size_t target_gpu_alloc_size, unsigned flags)
   : imp_(new GpuCacheDetail)
 {
-  imp_->gpu = ohm::gpuDevice();
-  imp_->gpu_queue = imp_->gpu.defaultQueue();
+  imp_->gpu = gpu;
+  if (flags & gpumap::kGpuProfile)
+  {
+    // Timing requires profiling queues, so we cannot use the default queue.
+    imp_->profiler = std::make_unique<gputil::Profiler>();
+    imp_->gpu_queue = imp_->gpu.createQueue(gputil::Queue::kProfile);
+  }
+  else
+  {
+    imp_->gpu_queue = imp_->gpu.defaultQueue();
+  }
+  if (flags & gpumap::kGpuTransferQueue)
+  {
+    imp_->transfer_queue = imp_->gpu.createQueue((imp_->profiler) ? gputil::Queue::kProfile : 0u);
+  }
   imp_->map = &map;
-  imp_->target_gpu_alloc_size = target_gpu_alloc_size;
+  imp_->requested_gpu_alloc_size = target_gpu_alloc_size;
   imp_->flags = flags;
+
+  std::shared_ptr<std::atomic<size_t>> pending_budget = imp_->pending_budget;
+  imp_->memory_consumer =
+    GpuMemoryConsumer(GpuMemoryArbiter::forDevice(gpu), "GpuCache", target_gpu_alloc_size,
+                      target_gpu_alloc_size / kMinBudgetDivisor,
+                      [pending_budget](size_t budget) { *pending_budget = std::max<size_t>(budget, 1u); });
+  // Start within the current budget. No layers have been allocated yet.
+  imp_->target_gpu_alloc_size = std::min(target_gpu_alloc_size, imp_->memory_consumer.budget());
+  *imp_->pending_budget = 0u;
 }
 
 
 GpuCache::~GpuCache()
 {
+  // No longer caching any layers.
+  imp_->map->memoryAccounting().setGpuBytes(std::vector<size_t>());
   delete imp_;
 }
 
@@ -91,6 +166,8 @@ void GpuCache::clear()
 void GpuCache::removeLayers()
 {
   imp_->layer_caches.clear();
+  imp_->layer_mem_fractions.clear();
+  imp_->reportMemoryUsage();
 }
 
 
@@ -159,6 +236,56 @@ size_t GpuCache::targetGpuAllocSize() const
 }
 
 
+size_t GpuCache::requestedGpuAllocSize() const
+{
+  return imp_->requested_gpu_alloc_size;
+}
+
+
+const GpuMemoryConsumer &GpuCache::memoryConsumer() const
+{
+  return imp_->memory_consumer;
+}
+
+
+bool GpuCache::memoryBudgetPending() const
+{
+  return *imp_->pending_budget != 0u;
+}
+
+
+bool GpuCache::applyMemoryBudget()
+{
+  const size_t budget = imp_->pending_budget->exchange(0u);
+  if (budget == 0u)
+  {
+    return false;
+  }
+
+  const size_t current = imp_->target_gpu_alloc_size;
+  const size_t target = std::min(budget, imp_->requested_gpu_alloc_size);
+  // Ignore small increases unless they restore the requested size.
+  if (target == current || current == 0 ||
+      (target > current && target < imp_->requested_gpu_alloc_size && target - current < current / kMinBudgetDivisor))
+  {
+    return false;
+  }
+
+  imp_->target_gpu_alloc_size = target;
+  for (size_t i = 0; i < imp_->layer_caches.size(); ++i)
+  {
+    if (GpuLayerCache *layer = imp_->layer_caches[i].get())
+    {
+      layer->syncToMainMemory();
+      layer->reallocate(*imp_->map, size_t(imp_->layer_mem_fractions[i] * double(target)));
+    }
+  }
+  imp_->reportMemoryUsage();
+
+  return true;
+}
+
+
 unsigned GpuCache::layerCount() const
 {
   return unsigned(imp_->layer_caches.size());
@@ -170,6 +297,7 @@ GpuLayerCache *GpuCache::createCache(unsigned id, const GpuLayerCacheParams &par
   while (id >= imp_->layer_caches.size())
   {
     imp_->layer_caches.push_back(nullptr);
+    imp_->layer_mem_fractions.push_back(0.0);
   }
 
   if (imp_->layer_caches[id])
@@ -181,6 +309,15 @@ GpuLayerCache *GpuCache::createCache(unsigned id, const GpuLayerCacheParams &par
   const size_t layer_mem_size = (params.gpu_mem_size) ? params.gpu_mem_size : kDefaultLayerMemSize;
   imp_->layer_caches[id] = std::make_unique<GpuLayerCache>(imp_->gpu, imp_->gpu_queue, *imp_->map, params.map_layer,
                                                            layer_mem_size, params.flags, params.on_sync);
+  imp_->layer_caches[id]->setEvictionPolicy(imp_->eviction_policy);
+  if (imp_->transfer_queue.isValid())
+  {
+    imp_->layer_caches[id]->setTransferQueue(imp_->transfer_queue);
+  }
+  imp_->layer_caches[id]->setProfiler(imp_->profiler.get());
+  imp_->layer_mem_fractions[id] =
+    (imp_->target_gpu_alloc_size) ? double(layer_mem_size) / double(imp_->target_gpu_alloc_size) : 0.0;
+  imp_->reportMemoryUsage();
 
   return imp_->layer_caches[id].get();
 }
@@ -219,4 +356,125 @@ const gputil::Queue &GpuCache::gpuQueue() const
 {
   return imp_->gpu_queue;
 }
+
+
+gputil::Queue &GpuCache::transferQueue()
+{
+  return (imp_->transfer_queue.isValid()) ? imp_->transfer_queue : imp_->gpu_queue;
+}
+
+
+gputil::Queue &GpuCache::prefetchQueue()
+{
+  if (imp_->transfer_queue.isValid())
+  {
+    // Prefetch on the transfer queue so the layer cache transfer events remain ordered.
+    return imp_->transfer_queue;
+  }
+  if (!imp_->prefetch_queue.isValid())
+  {
+    imp_->prefetch_queue = imp_->gpu.createQueue((imp_->profiler) ? gputil::Queue::kProfile : 0u);
+  }
+  return imp_->prefetch_queue;
+}
+
+
+gputil::Profiler *GpuCache::profiler() const
+{
+  return imp_->profiler.get();
+}
+
+
+GpuLayerCacheEviction GpuCache::evictionPolicy() const
+{
+  return imp_->eviction_policy;
+}
+
+
+void GpuCache::setEvictionPolicy(GpuLayerCacheEviction policy)
+{
+  imp_->eviction_policy = policy;
+  for (auto &&layer : imp_->layer_caches)
+  {
+    if (layer)
+    {
+      layer->setEvictionPolicy(policy);
+    }
+  }
+}
+
+
+unsigned GpuCache::prefetch(const glm::dvec3 *trajectory, size_t point_count, double range)
+{
+  if (!trajectory || point_count == 0)
+  {
+    return 0;
+  }
+
+  OccupancyMap &map = *imp_->map;
+  gputil::Queue &queue = prefetchQueue();
+
+  // Limit the prefetch to half the smallest layer cache.
+  unsigned budget = ~0u;
+  for (auto &&layer : imp_->layer_caches)
+  {
+    if (layer)
+    {
+      layer->setMotionHint(trajectory[0], trajectory[point_count - 1]);
+      budget = std::min(budget, std::max(1u, layer->cacheSize() / 2));
+    }
+  }
+
+  if (budget == ~0u)
+  {
+    // No layers.
+    return 0;
+  }
+
+  const double range_sqr = range * range;
+  GpuMapDetail::RegionSet visited;
+  unsigned prefetch_count = 0;
+  for (size_t i = 0; i < point_count && unsigned(visited.size()) < budget; ++i)
+  {
+    const glm::dvec3 &point = trajectory[i];
+    const glm::i16vec3 min_key = map.regionKey(point - glm::dvec3(range));
+    const glm::i16vec3 max_key = map.regionKey(point + glm::dvec3(range));
+    glm::i16vec3 region_key;
+    for (int z = min_key.z; z <= max_key.z && unsigned(visited.size()) < budget; ++z)
+    {
+      region_key.z = int16_t(z);
+      for (int y = min_key.y; y <= max_key.y && unsigned(visited.size()) < budget; ++y)
+      {
+        region_key.y = int16_t(y);
+        for (int x = min_key.x; x <= max_key.x && unsigned(visited.size()) < budget; ++x)
+        {
+          region_key.x = int16_t(x);
+
+          // Check the distance to the closest point in the region bounds.
+          const glm::dvec3 closest =
+            glm::clamp(point, map.regionSpatialMin(region_key), map.regionSpatialMax(region_key));
+          const glm::dvec3 separation = closest - point;
+          if (glm::dot(separation, separation) > range_sqr || !visited.insert(region_key).second)
+          {
+            continue;
+          }
+
+          bool queued = false;
+          for (auto &&layer : imp_->layer_caches)
+          {
+            if (layer)
+            {
+              queued = layer->prefetch(map, region_key, queue) || queued;
+            }
+          }
+          prefetch_count += !!queued;
+        }
+      }
+    }
+  }
+
+  // Submit the copies without waiting on completion.
+  queue.flush();
+  return prefetch_count;
+}
 }  // namespace ohm
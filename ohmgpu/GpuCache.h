@@ -8,13 +8,18 @@
 
 #include "OhmGpuConfig.h"
 
+#include "GpuLayerCacheParams.h"
+
 #include <ohm/MapRegionCache.h>
 
+#include <glm/fwd.hpp>
+
 #include <cstddef>
 
 namespace gputil
 {
 class Device;
+class Profiler;
 class Queue;
 }  // namespace gputil
 
@@ -22,6 +27,7 @@ namespace ohm
 {
 struct GpuCacheDetail;
 struct GpuLayerCacheParams;
+class GpuMemoryConsumer;
 class GpuLayerCache;
 class OccupancyMap;
 
@@ -62,6 +68,8 @@ enum GpuCacheId
   kGcIdIncidentNormal,
   /// Cache used for @c VoxelTsdf data.
   kGcIdTsdf,
+  /// Cache used for @c VoxelSecondarySample data.
+  kGcIdSecondarySample,
 };
 
 /// Provides access to the @c GpuLayerCache objects used to cache host voxel data in GPU memory and manage
@@ -96,6 +104,14 @@ public:
   /// @param flags The @c GpuFlag values to initialise the cache with.
   explicit GpuCache(OccupancyMap &map, size_t target_gpu_alloc_size = kDefaultTargetMemSize, unsigned flags = 0);
 
+  /// Instantiate the @c GpuCache for @p map using a specific @p gpu rather than @c gpuDevice() .
+  /// @param map The map to cache data for.
+  /// @param gpu The device to allocate GPU memory and execute on.
+  /// @param target_gpu_alloc_size The GPU memory target size. See @c targetGpuAllocSize() .
+  /// @param flags The @c GpuFlag values to initialise the cache with.
+  GpuCache(OccupancyMap &map, const gputil::Device &gpu, size_t target_gpu_alloc_size = kDefaultTargetMemSize,
+           unsigned flags = 0);
+
   /// Destructor, cleaning up all owned @c GpuLayerCache objects.
   ~GpuCache() override;
 
@@ -138,6 +154,32 @@ public:
   /// @return The default size of for a layer cache in bytes.
   size_t targetGpuAllocSize() const;
 
+  /// Query the GPU memory allocation size requested on construction. The @c targetGpuAllocSize() may be less than this
+  /// when limited by the @c GpuMemoryArbiter budget.
+  /// @return The requested GPU memory allocation size in bytes.
+  size_t requestedGpuAllocSize() const;
+
+  /// Access the registration of this cache with the @c GpuMemoryArbiter for the @c gpu() .
+  ///
+  /// The cache registers as an elastic consumer requesting @c requestedGpuAllocSize() bytes and requiring at least a
+  /// quarter of that. Budget changes are deferred until @c applyMemoryBudget() .
+  /// @return The memory consumer for this cache.
+  const GpuMemoryConsumer &memoryConsumer() const;
+
+  /// Check whether the @c GpuMemoryArbiter has changed the budget for this cache since the last
+  /// @c applyMemoryBudget() .
+  /// @return True if there is a budget change to apply.
+  bool memoryBudgetPending() const;
+
+  /// Resize the @c GpuLayerCache buffers to match the latest @c GpuMemoryArbiter budget.
+  ///
+  /// Each layer is synchronised to main memory then reallocated, retaining the relative layer sizes. This must only be
+  /// called when there are no outstanding GPU operations using the layer caches. Small increases in the budget are
+  /// ignored to avoid repeated reallocation, while a budget below the current allocation is always applied.
+  ///
+  /// @return True if the layer caches have been reallocated.
+  bool applyMemoryBudget();
+
   /// Returns the number of indexable layers. Some may be null.
   /// @return The number of indexable layers.
   unsigned layerCount() const;
@@ -175,6 +217,46 @@ public:
   /// @overload
   const gputil::Queue &gpuQueue() const;
 
+  /// Access the queue used for layer cache uploads and downloads. This is a dedicated queue when created with
+  /// @c gpumap::kGpuTransferQueue , allowing region transfers to overlap kernels on the @c gpuQueue() . Otherwise
+  /// this is the @c gpuQueue() .
+  /// @return The transfer queue.
+  gputil::Queue &transferQueue();
+
+  /// Access the queue used by @c prefetch() . This is a separate queue to @c gpuQueue() so prefetch copies may overlap
+  /// other GPU work. This is the @c transferQueue() when using @c gpumap::kGpuTransferQueue , otherwise it is created
+  /// on first use.
+  /// @return The prefetch queue.
+  gputil::Queue &prefetchQueue();
+
+  /// Access the profiler collecting device timing for the GPU commands of this cache and the @c GpuMap using it. Only
+  /// available when created with @c gpumap::kGpuProfile .
+  /// @return The profiler or null when profiling is not enabled.
+  gputil::Profiler *profiler() const;
+
+  /// Query the eviction policy applied to the @c GpuLayerCache objects.
+  /// @return The current eviction policy.
+  GpuLayerCacheEviction evictionPolicy() const;
+
+  /// Set the eviction policy for all current and future @c GpuLayerCache objects.
+  /// @param policy The eviction policy to set.
+  void setEvictionPolicy(GpuLayerCacheEviction policy);
+
+  /// Upload regions along a predicted sensor trajectory ahead of time.
+  ///
+  /// Each existing map region within @p range of a @p trajectory point is prefetched into each @c GpuLayerCache using
+  /// @c GpuLayerCache::prefetch() on the @c prefetchQueue() . Points are processed in order, so the @p trajectory
+  /// should start at or near the current sensor position. The number of prefetched regions is limited to half the
+  /// smallest layer cache so that regions for the current working set are not dropped.
+  ///
+  /// This also sets the motion hint for @c kGceMotion from the first to the last trajectory point.
+  ///
+  /// @param trajectory The predicted sensor positions.
+  /// @param point_count The number of elements in @p trajectory .
+  /// @param range The distance around each trajectory point within which to prefetch regions.
+  /// @return The number of regions queued for upload to at least one layer cache.
+  unsigned prefetch(const glm::dvec3 *trajectory, size_t point_count, double range);
+
 private:
   GpuCacheDetail *imp_;
 };
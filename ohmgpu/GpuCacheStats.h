@@ -15,9 +15,13 @@ namespace ohm
 /// Running stats on a @c GpuLayerCache .
 struct ohmgpu_API GpuCacheStats
 {
-  uint32_t hits = 0;    ///< Number of cache hits
-  uint32_t misses = 0;  ///< Number of cache misses.
-  uint32_t full = 0;    ///< Number of misses where the cache was full and something had to be dropped.
+  uint32_t hits = 0;           ///< Number of cache hits
+  uint32_t misses = 0;         ///< Number of cache misses.
+  uint32_t full = 0;           ///< Number of misses where the cache was full and something had to be dropped.
+  uint32_t prefetches = 0;     ///< Number of regions uploaded by @c GpuLayerCache::prefetch() .
+  uint32_t prefetch_hits = 0;  ///< Number of prefetched regions which were later hit by an upload or allocation.
+  uint32_t partial_syncs = 0;  ///< Number of region syncs to main memory which only downloaded dirty spans.
+  uint32_t skipped_syncs = 0;  ///< Number of region syncs to main memory skipped as no spans were dirty.
 };
 }  // namespace ohm
 
@@ -0,0 +1,460 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "GpuHybridMap.h"
+
+#include "GpuCache.h"
+#include "GpuMap.h"
+
+#include <ohm/CopyUtil.h>
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/TaskArena.h>
+
+#include <ohm/private/OccupancyMapDetail.h>
+
+#include <ohmutil/VectorHash.h>
+
+#include <glm/glm.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/task_group.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace ohm
+{
+struct GpuHybridMapDetail
+{
+  /// The target map. Updated directly by the @c gpu_map .
+  OccupancyMap *map = nullptr;
+  /// Shard map holding the CPU owned regions.
+  std::unique_ptr<OccupancyMap> shard_map;
+  /// The GPU mapper for the target map.
+  std::unique_ptr<GpuMap> gpu_map;
+  /// The CPU mapper for the @c shard_map .
+  std::unique_ptr<RayMapperOccupancy> cpu_mapper;
+  /// Ray batch routed to the CPU.
+  std::vector<glm::dvec3> cpu_rays;
+  /// Intensity values routed to the CPU.
+  std::vector<float> cpu_intensities;
+  /// Timestamp values routed to the CPU.
+  std::vector<double> cpu_timestamps;
+  /// Ray batch routed to the GPU.
+  std::vector<glm::dvec3> gpu_rays;
+  /// Intensity values routed to the GPU.
+  std::vector<float> gpu_intensities;
+  /// Timestamp values routed to the GPU.
+  std::vector<double> gpu_timestamps;
+  /// Input rays after the ray filter pass, used for routing.
+  std::vector<glm::dvec3> filtered_rays;
+  /// @c RayFilterFlag values for each of the @c filtered_rays .
+  std::vector<unsigned> filter_flags;
+  /// Smoothed CPU rays per second.
+  double cpu_rate = 0;
+  /// Smoothed GPU rays per second.
+  double gpu_rate = 0;
+  /// Number of ownership bins owned by the CPU.
+  unsigned cpu_bins = 0;
+  /// Number of @c integrateRays() calls between rebalancing.
+  unsigned rebalance_interval = 16;  // NOLINT(readability-magic-numbers)
+  /// Number of @c integrateRays() calls since the last rebalance.
+  unsigned batches_since_rebalance = 0;
+  /// Dynamic balancing enabled?
+  bool dynamic_balance = true;
+};
+
+namespace
+{
+/// Weighting of each new throughput measurement in the smoothed rates.
+const double kRateSmoothing = 0.25;
+/// Minimum change in CPU bins required to rebalance. Avoids migrating regions for measurement noise.
+const unsigned kMinRebalanceBins = 2;
+
+inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((-value - 1) / divisor) - 1;
+}
+
+inline unsigned ownershipBin(const glm::i16vec3 &region_key)
+{
+  const uint32_t hash = vhash::hash(floorDiv(region_key.x, GpuHybridMap::kRegionBlockSize),
+                                    floorDiv(region_key.y, GpuHybridMap::kRegionBlockSize),
+                                    floorDiv(region_key.z, GpuHybridMap::kRegionBlockSize));
+  return hash % GpuHybridMap::kOwnershipBins;
+}
+
+inline void smoothRate(double &rate, size_t rays, double seconds)
+{
+  if (rays == 0 || seconds <= 0)
+  {
+    return;
+  }
+
+  const double sample = double(rays) / seconds;
+  rate = (rate > 0) ? rate + kRateSmoothing * (sample - rate) : sample;
+}
+}  // namespace
+
+
+GpuHybridMap::GpuHybridMap(OccupancyMap *map, unsigned expected_element_count, size_t gpu_mem_size, float cpu_share)
+  : imp_(std::make_unique<GpuHybridMapDetail>())
+{
+  imp_->map = map;
+  if (!map)
+  {
+    return;
+  }
+
+  imp_->cpu_bins = unsigned(std::round(std::max(0.0f, std::min(cpu_share, 1.0f)) * float(kOwnershipBins)));
+
+  // Build a shard map matching the target map configuration, seeded with the regions the CPU owns.
+  imp_->shard_map = std::make_unique<OccupancyMap>(map->resolution(), map->regionVoxelDimensions());
+  OccupancyMap &shard = *imp_->shard_map;
+  shard.detail()->copyFrom(*map->detail());
+  if (map->rayFilter())
+  {
+    shard.setRayFilter(map->rayFilter());
+  }
+  shard.setRayBatchFilter(map->rayBatchFilter());
+  copyMap(shard, *map, [this](const MapChunk &chunk) { return cpuOwned(chunk.region.coord); });
+
+  imp_->gpu_map = std::make_unique<GpuMap>(map, true, expected_element_count, gpu_mem_size);
+  imp_->gpu_map->setRegionFilter([this](const glm::i16vec3 &region_key) { return !cpuOwned(region_key); });
+
+  imp_->cpu_mapper = std::make_unique<RayMapperOccupancy>(&shard);
+  imp_->cpu_mapper->setUseThreads(true);
+  imp_->cpu_mapper->setRegionFilter([this](const glm::i16vec3 &region_key) { return cpuOwned(region_key); });
+}
+
+
+GpuHybridMap::~GpuHybridMap()
+{
+  if (imp_->map)
+  {
+    syncVoxels();
+  }
+  // Release the mappers before the shard map they reference.
+  imp_->cpu_mapper.reset();
+  imp_->gpu_map.reset();
+  imp_->shard_map.reset();
+}
+
+
+bool GpuHybridMap::valid() const
+{
+  return imp_->gpu_map && imp_->gpu_map->gpuOk();
+}
+
+
+OccupancyMap &GpuHybridMap::map()
+{
+  return *imp_->map;
+}
+
+
+const OccupancyMap &GpuHybridMap::map() const
+{
+  return *imp_->map;
+}
+
+
+GpuMap &GpuHybridMap::gpuMap()
+{
+  return *imp_->gpu_map;
+}
+
+
+const GpuMap &GpuHybridMap::gpuMap() const
+{
+  return *imp_->gpu_map;
+}
+
+
+RayMapperOccupancy &GpuHybridMap::cpuMapper()
+{
+  return *imp_->cpu_mapper;
+}
+
+
+const RayMapperOccupancy &GpuHybridMap::cpuMapper() const
+{
+  return *imp_->cpu_mapper;
+}
+
+
+unsigned GpuHybridMap::cpuBins() const
+{
+  return imp_->cpu_bins;
+}
+
+
+float GpuHybridMap::cpuShare() const
+{
+  return float(imp_->cpu_bins) / float(kOwnershipBins);
+}
+
+
+void GpuHybridMap::setCpuShare(float share)
+{
+  migrate(unsigned(std::round(std::max(0.0f, std::min(share, 1.0f)) * float(kOwnershipBins))));
+}
+
+
+bool GpuHybridMap::dynamicBalance() const
+{
+  return imp_->dynamic_balance;
+}
+
+
+void GpuHybridMap::setDynamicBalance(bool enable)
+{
+  imp_->dynamic_balance = enable;
+}
+
+
+unsigned GpuHybridMap::rebalanceInterval() const
+{
+  return imp_->rebalance_interval;
+}
+
+
+void GpuHybridMap::setRebalanceInterval(unsigned interval)
+{
+  imp_->rebalance_interval = std::max(interval, 1u);
+}
+
+
+bool GpuHybridMap::cpuOwned(const glm::i16vec3 &region_key) const
+{
+  return ownershipBin(region_key) < imp_->cpu_bins;
+}
+
+
+double GpuHybridMap::cpuRayRate() const
+{
+  return imp_->cpu_rate;
+}
+
+
+double GpuHybridMap::gpuRayRate() const
+{
+  return imp_->gpu_rate;
+}
+
+
+void GpuHybridMap::syncVoxels()
+{
+  if (!imp_->gpu_map)
+  {
+    return;
+  }
+
+  imp_->gpu_map->syncVoxels();
+  // Gather the CPU regions. The shard may also hold stale copies of regions since migrated to the GPU.
+  copyMap(*imp_->map, *imp_->shard_map, [this](const MapChunk &chunk) { return cpuOwned(chunk.region.coord); });
+}
+
+
+size_t GpuHybridMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
+                                   const double *timestamps, unsigned ray_update_flags)
+{
+  if (!valid())
+  {
+    return 0u;
+  }
+
+  GpuHybridMapDetail &imp = *imp_;
+  if (timestamps && element_count >= 2)
+  {
+    // Touch times are encoded relative to the first ray time. Ensure the shard shares the target map value.
+    imp.shard_map->setFirstRayTime(imp.map->updateFirstRayTime(*timestamps));
+  }
+
+  imp.cpu_rays.clear();
+  imp.cpu_intensities.clear();
+  imp.cpu_timestamps.clear();
+  imp.gpu_rays.clear();
+  imp.gpu_intensities.clear();
+  imp.gpu_timestamps.clear();
+
+  // Route the rays. We walk the filtered ray, but submit the original ray as each side applies the filter again.
+  imp.filtered_rays.assign(rays, rays + (element_count & ~size_t(1u)));
+  imp.filter_flags.resize(element_count / 2);
+  filterRays(imp.filtered_rays.data(), imp.filter_flags.data(), element_count / 2,
+             imp.gpu_map->effectiveRayBatchFilter(), imp.gpu_map->effectiveRayFilter());
+
+  bool touched_cpu = false;
+  bool touched_gpu = false;
+  const auto mark_owner = [this, &touched_cpu, &touched_gpu](const glm::i16vec3 &region_key,
+                                                             const glm::dvec3 & /*origin*/,
+                                                             const glm::dvec3 & /*sample*/) {
+    if (cpuOwned(region_key))
+    {
+      touched_cpu = true;
+    }
+    else
+    {
+      touched_gpu = true;
+    }
+  };
+
+  const auto route = [&](std::vector<glm::dvec3> &dst_rays, std::vector<float> &dst_intensities,
+                         std::vector<double> &dst_timestamps, size_t i) {
+    dst_rays.emplace_back(rays[i + 0]);
+    dst_rays.emplace_back(rays[i + 1]);
+    if (intensities)
+    {
+      dst_intensities.emplace_back(intensities[i >> 1u]);
+    }
+    if (timestamps)
+    {
+      dst_timestamps.emplace_back(timestamps[i >> 1u]);
+    }
+  };
+
+  size_t routed_count = 0;
+  for (size_t i = 0; i + 1 < element_count; i += 2)
+  {
+    if (imp.filter_flags[i >> 1u] & kRffInvalid)
+    {
+      continue;
+    }
+
+    touched_cpu = touched_gpu = false;
+    gpumap::walkRegions(*imp.map, imp.filtered_rays[i + 0], imp.filtered_rays[i + 1], mark_owner);
+
+    if (touched_cpu)
+    {
+      route(imp.cpu_rays, imp.cpu_intensities, imp.cpu_timestamps, i);
+    }
+    if (touched_gpu)
+    {
+      route(imp.gpu_rays, imp.gpu_intensities, imp.gpu_timestamps, i);
+    }
+    routed_count += 2;
+  }
+
+  using Clock = std::chrono::high_resolution_clock;
+  double cpu_seconds = 0;
+  double gpu_seconds = 0;
+  const auto integrate_cpu = [&]() {
+    if (!imp.cpu_rays.empty())
+    {
+      const auto start_time = Clock::now();
+      imp.cpu_mapper->integrateRays(imp.cpu_rays.data(), imp.cpu_rays.size(),
+                                    (intensities) ? imp.cpu_intensities.data() : nullptr,
+                                    (timestamps) ? imp.cpu_timestamps.data() : nullptr, ray_update_flags);
+      cpu_seconds = std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time).count();
+    }
+  };
+  const auto integrate_gpu = [&]() {
+    if (!imp.gpu_rays.empty())
+    {
+      const auto start_time = Clock::now();
+      imp.gpu_map->integrateRays(imp.gpu_rays.data(), imp.gpu_rays.size(),
+                                 (intensities) ? imp.gpu_intensities.data() : nullptr,
+                                 (timestamps) ? imp.gpu_timestamps.data() : nullptr, ray_update_flags);
+      gpu_seconds = std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time).count();
+    }
+  };
+
+  // The sides update disjoint maps, so the CPU update runs as a task while this thread submits the GPU batch.
+#ifdef OHM_FEATURE_THREADS
+  parallelExecute([&]() {
+    tbb::task_group cpu_task;
+    cpu_task.run(integrate_cpu);
+    integrate_gpu();
+    cpu_task.wait();
+  });
+#else   // OHM_FEATURE_THREADS
+  integrate_gpu();
+  integrate_cpu();
+#endif  // OHM_FEATURE_THREADS
+
+  balance(imp.cpu_rays.size() / 2, cpu_seconds, imp.gpu_rays.size() / 2, gpu_seconds);
+
+  return routed_count;
+}
+
+
+void GpuHybridMap::migrate(unsigned cpu_bins)
+{
+  GpuHybridMapDetail &imp = *imp_;
+  cpu_bins = std::min(cpu_bins, unsigned(kOwnershipBins));
+  if (!imp.map || cpu_bins == imp.cpu_bins)
+  {
+    return;
+  }
+
+  const unsigned bin_begin = std::min(cpu_bins, imp.cpu_bins);
+  const unsigned bin_end = std::max(cpu_bins, imp.cpu_bins);
+  const auto moving = [bin_begin, bin_end](const MapChunk &chunk) {
+    const unsigned bin = ownershipBin(chunk.region.coord);
+    return bin_begin <= bin && bin < bin_end;
+  };
+
+  if (cpu_bins > imp.cpu_bins)
+  {
+    // GPU to CPU. Bring the target map up to date, then drop the regions from the GPU cache so the GPU cannot later
+    // write back or reuse stale copies. GpuCache::remove() does not sync, which is why we sync everything first.
+    imp.gpu_map->syncVoxels();
+    std::vector<const MapChunk *> chunks;
+    imp.map->enumerateRegions(chunks);
+    GpuCache *gpu_cache = imp.gpu_map->gpuCache();
+    for (const MapChunk *chunk : chunks)
+    {
+      if (gpu_cache && moving(*chunk))
+      {
+        gpu_cache->remove(chunk->region.coord);
+      }
+    }
+    copyMap(*imp.shard_map, *imp.map, moving);
+  }
+  else
+  {
+    // CPU to GPU. The GPU cache holds none of these regions, so it uploads them from the target map on next use.
+    copyMap(*imp.map, *imp.shard_map, moving);
+  }
+
+  imp.cpu_bins = cpu_bins;
+  imp.batches_since_rebalance = 0;
+}
+
+
+void GpuHybridMap::balance(size_t cpu_rays, double cpu_seconds, size_t gpu_rays, double gpu_seconds)
+{
+  GpuHybridMapDetail &imp = *imp_;
+  smoothRate(imp.cpu_rate, cpu_rays, cpu_seconds);
+  smoothRate(imp.gpu_rate, gpu_rays, gpu_seconds);
+
+  if (!imp.dynamic_balance || ++imp.batches_since_rebalance < imp.rebalance_interval)
+  {
+    return;
+  }
+  imp.batches_since_rebalance = 0;
+
+  if (imp.cpu_rate <= 0 || imp.gpu_rate <= 0)
+  {
+    return;
+  }
+
+  // Each bin receives roughly the same number of rays, so equal completion times result from sharing the bins in
+  // proportion to the throughput of each side.
+  const double target_share = imp.cpu_rate / (imp.cpu_rate + imp.gpu_rate);
+  const auto target_bins = unsigned(std::max(1.0, std::min(std::round(target_share * kOwnershipBins),
+                                                           double(kOwnershipBins - 1))));
+  const unsigned delta = (target_bins > imp.cpu_bins) ? target_bins - imp.cpu_bins : imp.cpu_bins - target_bins;
+  if (delta >= kMinRebalanceBins || imp.cpu_bins == 0 || imp.cpu_bins == kOwnershipBins)
+  {
+    migrate(target_bins);
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,173 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPUHYBRIDMAP_H
+#define OHMGPU_GPUHYBRIDMAP_H
+
+#include "OhmGpuConfig.h"
+
+#include <ohm/RayMapper.h>
+
+#include <glm/fwd.hpp>
+
+#include <memory>
+
+namespace ohm
+{
+class GpuMap;
+class OccupancyMap;
+class RayMapperOccupancy;
+struct GpuHybridMapDetail;
+
+/// A @c RayMapper which splits occupancy updates for an @c OccupancyMap between a @c GpuMap and a multi-threaded CPU
+/// @c RayMapperOccupancy so that otherwise idle CPU cores contribute to GPU map population.
+///
+/// Region ownership is assigned by hashing region keys, in blocks of @c kRegionBlockSize regions along each axis,
+/// into @c kOwnershipBins bins. The first @c cpuBins() bins are owned by the CPU, the remainder by the GPU. Blocks
+/// preserve some spatial locality so that most rays are only submitted to one side.
+///
+/// The @c gpuMap() operates directly on the target @c map() . The @c cpuMapper() operates on a shard map with the same
+/// configuration as the target map, seeded with the target map regions owned by the CPU. @c syncVoxels() gathers the
+/// CPU regions back into the target map.
+///
+/// @c integrateRays() filters the rays using the @c OccupancyMap::rayBatchFilter() or @c OccupancyMap::rayFilter()
+/// then submits each ray to each side which owns at least one region touched by the ray. Each side only updates the
+/// regions it owns, using @c GpuMap::setRegionFilter() and @c RayMapperOccupancy::setRegionFilter() . The CPU update
+/// runs as a TBB task while the GPU batch is submitted from the calling thread.
+///
+/// With @c dynamicBalance() enabled, the ray throughput of each side is measured on every batch and the CPU share of
+/// the bins is periodically adjusted towards equal completion times. Migrating regions from the GPU to the CPU first
+/// synchronises the GPU and removes the regions from the @c GpuCache so that the GPU holds no stale copy should the
+/// regions later return to it. Migrating regions from the CPU to the GPU copies them into the target map before the
+/// GPU next uploads them.
+///
+/// Limitations:
+/// - Only occupancy updates are supported. Derivations such as @c GpuNdtMap and @c GpuTsdfMap are not split.
+/// - @c kRfStopOnFirstOccupied is only respected within each side's regions, so rays crossing an ownership boundary
+///   may continue past occupied voxels owned by the other side.
+/// - The shard map holds a copy of the CPU owned regions, and a stale copy of regions migrated back to the GPU.
+/// - The target map ray filters are copied to the shard map on construction. Later changes only affect the GPU.
+/// - The target map must not be modified other than via this object, and should only be read after
+///   @c syncVoxels() .
+class ohmgpu_API GpuHybridMap : public RayMapper
+{
+public:
+  /// Number of regions along each axis in each block of regions assigned to a single side.
+  static const int kRegionBlockSize = 4;
+  /// Number of ownership bins region blocks are hashed into. This sets the granularity of the load balance.
+  static const unsigned kOwnershipBins = 64;
+
+  /// Create a hybrid mapper for @p map . The @p map pointer is borrowed and must outlive this object.
+  ///
+  /// @exception gputil::Exception Thrown when a @c gputil::ApiException is raised during GPU memory allocation.
+  ///
+  /// @param map The map to update.
+  /// @param expected_element_count The expected point count for calls to @c integrateRays(). Used as a hint.
+  /// @param gpu_mem_size Optionally specify the target GPU cache memory to allocate.
+  /// @param cpu_share The initial fraction of the map regions owned by the CPU. See @c setCpuShare() .
+  GpuHybridMap(OccupancyMap *map, unsigned expected_element_count = 2048,  // NOLINT(readability-magic-numbers)
+               size_t gpu_mem_size = 0u, float cpu_share = 0.25f);  // NOLINT(readability-magic-numbers)
+
+  /// Destructor. Gathers the CPU updates into the @c map() .
+  ~GpuHybridMap() override;
+
+  /// Validate function from @c RayMapper . True when the @c GpuMap::gpuOk() .
+  /// @return True if validated and @c integrateRays() is safe to call.
+  bool valid() const override;
+
+  /// Access the target map.
+  /// @return The map being updated.
+  OccupancyMap &map();
+  /// @overload
+  const OccupancyMap &map() const;
+
+  /// Access the @c GpuMap updating the GPU owned regions of the @c map() .
+  /// @return The GPU mapper.
+  GpuMap &gpuMap();
+  /// @overload
+  const GpuMap &gpuMap() const;
+
+  /// Access the @c RayMapperOccupancy updating the CPU owned regions in the shard map.
+  /// @return The CPU mapper.
+  RayMapperOccupancy &cpuMapper();
+  /// @overload
+  const RayMapperOccupancy &cpuMapper() const;
+
+  /// Query the number of ownership bins currently owned by the CPU `[0, kOwnershipBins]` .
+  /// @return The CPU bin count.
+  unsigned cpuBins() const;
+
+  /// Query the fraction of the ownership bins currently owned by the CPU.
+  /// @return The CPU share `[0, 1]` .
+  float cpuShare() const;
+
+  /// Set the fraction of the map regions owned by the CPU, migrating regions between the sides as required. The share
+  /// is quantised to whole ownership bins. This may later be adjusted when @c dynamicBalance() is enabled.
+  /// @param share The CPU share, clamped to `[0, 1]` .
+  void setCpuShare(float share);
+
+  /// Query if the CPU share is dynamically balanced from the measured throughput.
+  /// @return True if dynamic balancing is enabled.
+  bool dynamicBalance() const;
+
+  /// Enable or disable dynamic balancing of the CPU share. Enabled by default. Balancing keeps the CPU between one and
+  /// `kOwnershipBins - 1` bins so that the throughput of both sides remains measurable, but only starts once both
+  /// sides have been measured.
+  /// @param enable True to enable dynamic balancing.
+  void setDynamicBalance(bool enable);
+
+  /// Query the number of @c integrateRays() calls between dynamic balance adjustments.
+  /// @return The rebalance interval.
+  unsigned rebalanceInterval() const;
+
+  /// Set the number of @c integrateRays() calls between dynamic balance adjustments. Each adjustment may synchronise
+  /// the GPU, so frequent adjustment trades throughput for responsiveness.
+  /// @param interval The rebalance interval. Zero is treated as one.
+  void setRebalanceInterval(unsigned interval);
+
+  /// Query if the region at @p region_key is owned by the CPU.
+  /// @param region_key The region of interest.
+  /// @return True if the CPU owns the region, false if the GPU owns it.
+  bool cpuOwned(const glm::i16vec3 &region_key) const;
+
+  /// Query the measured CPU throughput as a smoothed average.
+  /// @return The CPU rays per second, or zero before any measurement.
+  double cpuRayRate() const;
+
+  /// Query the measured GPU throughput as a smoothed average. This measures the host time spent submitting the GPU
+  /// batch, which includes waiting on the GPU for previous batches, so tracks the sustained throughput.
+  /// @return The GPU rays per second, or zero before any measurement.
+  double gpuRayRate() const;
+
+  /// Sync the GPU back to main memory and gather the CPU owned regions from the shard map into the @c map() .
+  void syncVoxels();
+
+  /// Integrate the given @p rays into the map, routing each ray to the sides which own the regions it touches.
+  /// See @c GpuMap::integrateRays() .
+  ///
+  /// @param rays Array of origin/sample point pairs.
+  /// @param element_count The number of points in @p rays. The ray count is half this value.
+  /// @param intensities Optional intensity values, one per ray.
+  /// @param timestamps Optional timestamp values, one per ray.
+  /// @param ray_update_flags Flags controlling ray integration behaviour. See @c RayFlag.
+  /// @return The number of elements in @p rays which passed the ray filter and were submitted.
+  size_t integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
+                       const double *timestamps, unsigned ray_update_flags) override;
+
+  using RayMapper::integrateRays;
+
+private:
+  /// Migrate ownership so that the CPU owns @p cpu_bins bins, moving the affected regions between the maps.
+  /// @param cpu_bins The new CPU bin count `[0, kOwnershipBins]` .
+  void migrate(unsigned cpu_bins);
+
+  /// Update the throughput measurements and rebalance if due.
+  void balance(size_t cpu_rays, double cpu_seconds, size_t gpu_rays, double gpu_seconds);
+
+  std::unique_ptr<GpuHybridMapDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_GPUHYBRIDMAP_H
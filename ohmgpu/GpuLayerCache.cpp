@@ -8,16 +8,26 @@
 #include "GpuCacheStats.h"
 #include "GpuLayerCacheParams.h"
 
+#include "gpu/RegionTable.h"
+
+#include "private/GpuMapSnapshotDetail.h"
+
+#include <cmath>
+
+#include "gpu/PackedOccupancy.h"
+
 #include <ohm/DefaultLayer.h>
 #include <ohm/MapChunk.h>
 #include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
 #include <ohm/MapRegion.h>
+#include <ohm/MemoryTrack.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/VoxelBlock.h>
 #include <ohm/VoxelBuffer.h>
 
 #include <gputil/gpuDevice.h>
+#include <gputil/gpuProfiler.h>
 
 #include <ohmutil/VectorHash.h>
 
@@ -32,10 +42,25 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <stdexcept>
 #include <memory>
+#include <string>
 
 namespace ohm
 {
+namespace
+{
+const uint32_t kAllDirtySpans = ~0u;
+}  // namespace
+
+
+GpuDirtySpanSet::~GpuDirtySpanSet()
+{
+  read_event.wait();
+}
+
+
 /// Data required for a single cache entry.
 struct GpuCacheEntry  // NOLINT
 {
@@ -50,6 +75,8 @@ struct GpuCacheEntry  // NOLINT
   gputil::Event sync_event;
   /// Stamp value used to assess the oldest cache entry.
   uint64_t age_stamp = 0;
+  /// Number of times the entry has been resolved. Used by @c kGceFrequency .
+  uint32_t use_count = 0;
   /// Retains uncompressed voxel memory while the chunk remains in the cache.
   VoxelBuffer<VoxelBlock> voxel_buffer;
   // FIXME: (KS) Would be nice to resolve how chunk stamping is managed to sync between GPU and CPU.
@@ -61,6 +88,24 @@ struct GpuCacheEntry  // NOLINT
   unsigned batch_marker = 0;
   /// Can/should download of this item be skipped?
   bool skip_download = true;
+  /// Does the GPU memory hold the only copy of the region voxels? Set for @c kGcfResident entries which may be
+  /// modified but have no host @c chunk . The host chunk is created on sync.
+  bool resident = false;
+  /// Was the entry added by @c GpuLayerCache::prefetch() and not yet used?
+  bool prefetched = false;
+  /// Bit mask of spans modified on GPU and not yet synchronised to main memory. See
+  /// @c GpuLayerCache::kDirtySpanCount .
+  uint32_t dirty_spans = 0;
+  /// Dirty span sets reported for this entry, with the index of the entry in each set. Merged into @c dirty_spans
+  /// on sync.
+  std::vector<std::pair<std::shared_ptr<const GpuDirtySpanSet>, unsigned>> pending_dirty_spans;
+  /// Staging memory for @c kGcfPackedOccupancy transfers, holding the packed voxel values.
+  std::vector<uint16_t> packed;
+  /// Tracks the @c packed capacity.
+  memorytrack::BufferTracker packed_track{ MemorySubsystem::kGpuStaging };
+  /// Set when a download into @c packed is queued and must be unpacked to @c voxel_buffer once @c sync_event
+  /// completes.
+  bool unpack_pending = false;
 };
 
 struct GpuLayerCacheDetail
@@ -72,6 +117,8 @@ struct GpuLayerCacheDetail
 
   // Not part of the public API. We can put whatever we want here.
   std::unique_ptr<gputil::Buffer> buffer;
+  /// Host address of @c buffer when allocated in unified memory (@c kGcfUnified ). Null otherwise.
+  uint8_t *unified_mem = nullptr;
   unsigned cache_size = 0;
   unsigned batch_marker = 1;
   CacheMap cache;
@@ -80,9 +127,34 @@ struct GpuLayerCacheDetail
   std::vector<size_t> mem_offset_free_list;
   glm::u8vec3 region_size = glm::u8vec3(0);
   uint64_t age_stamp = 0;
+  /// Number of evictions since the @c GpuCacheEntry::use_count values were last halved.
+  unsigned evictions_since_decay = 0;
+  /// Motion hint line segment start for @c kGceMotion .
+  glm::dvec3 motion_start = glm::dvec3(0);
+  /// Motion hint line segment end for @c kGceMotion .
+  glm::dvec3 motion_end = glm::dvec3(0);
+  /// Has a motion hint been set?
+  bool have_motion_hint = false;
+  GpuLayerCacheEviction eviction_policy = kGceLru;
   gputil::Queue gpu_queue;
+  /// Optional queue for cache uploads and downloads, allowing transfers to overlap work on @c gpu_queue .
+  gputil::Queue transfer_queue;
+  /// Most recent operation queued on @c transfer_queue . The queue is in order, so this marks the completion of all
+  /// transfers for this layer.
+  gputil::Event last_transfer_event;
+  /// Optional profiler recording transfer timing. See @c GpuLayerCache::setProfiler() .
+  gputil::Profiler *profiler = nullptr;
+  /// @c profiler name for uploads.
+  std::string upload_profile_name;
+  /// @c profiler name for downloads.
+  std::string download_profile_name;
   gputil::Device gpu;
+  /// Byte size of a cached chunk in @c buffer .
   size_t chunk_mem_size = 0;
+  /// Number of voxels in each cached chunk.
+  size_t chunk_voxel_count = 0;
+  /// Byte size of each dirty span in a cached chunk. Zero when the layer does not support dirty spans.
+  size_t dirty_span_size = 0;
   /// Initial target allocation size.
   size_t target_gpu_mem_size = 0;
   /// Map layer from which we read or write data
@@ -91,9 +163,25 @@ struct GpuLayerCacheDetail
   uint8_t *dummy_chunk = nullptr;
   OccupancyMap *map = nullptr;
   GpuCachePostSyncHandler on_sync;
+  /// Host copy of the region table for @c kGcfRegionTable . Empty when the table is disabled. The size is the table
+  /// capacity: a power of two.
+  std::vector<RegionTableEntry> region_table;
+  /// Staging copy of @c region_table for asynchronous upload by @c GpuLayerCache::syncRegionTable() .
+  std::vector<RegionTableEntry> region_table_staging;
+  /// Tracks the @c region_table capacity.
+  memorytrack::BufferTracker region_table_track{ MemorySubsystem::kGpuStaging };
+  /// Tracks the @c region_table_staging capacity.
+  memorytrack::BufferTracker region_table_staging_track{ MemorySubsystem::kGpuStaging };
+  /// Device copy of @c region_table .
+  std::unique_ptr<gputil::Buffer> region_table_buffer;
+  /// Marks completion of the last @c region_table_buffer upload from @c region_table_staging .
+  gputil::Event region_table_upload_event;
+  /// Has @c region_table been modified since the last upload?
+  bool region_table_dirty = false;
 
   ~GpuLayerCacheDetail()
   {
+    region_table_upload_event.wait();
     delete[] dummy_chunk;
     // We must clean up the cache explicitly. Otherwise it may be cleaned up after the _gpu device, in which case
     // the events will no longer be valid.
@@ -101,6 +189,248 @@ struct GpuLayerCacheDetail
   }
 };
 
+namespace
+{
+/// Select the queue for cache memory transfers: the transfer queue when available or the GPU queue otherwise.
+gputil::Queue &transferQueue(GpuLayerCacheDetail &imp)
+{
+  return (imp.transfer_queue.isValid()) ? imp.transfer_queue : imp.gpu_queue;
+}
+
+
+/// Flush the GPU queue before queuing a transfer which waits on @p block_on . The event may come from the GPU queue
+/// and OpenCL requires that queue be flushed before another queue waits on it.
+void flushForTransfer(GpuLayerCacheDetail &imp, const gputil::Event *block_on)
+{
+  if (block_on && imp.transfer_queue.isValid())
+  {
+    imp.gpu_queue.flush();
+  }
+}
+
+
+/// Note a transfer queued on @p queue with completion @p event . Transfers on the transfer queue are flushed so
+/// operations on other queues may wait on them.
+void trackTransfer(GpuLayerCacheDetail &imp, gputil::Queue *queue, const gputil::Event &event)
+{
+  if (queue && imp.transfer_queue.isValid() && queue->internal() == imp.transfer_queue.internal())
+  {
+    imp.last_transfer_event = event;
+    queue->flush();
+  }
+}
+
+
+/// Select the event reported for @p entry from @c GpuLayerCache::upload() and @c GpuLayerCache::allocate() .
+///
+/// Callers generally wait on the event for the last region they resolve, relying on an in order queue to cover the
+/// other regions. With a transfer queue that only holds when we report the most recent transfer, which covers all
+/// transfers for this layer - including downloads which must complete before the memory is modified again.
+gputil::Event dependencyEvent(const GpuLayerCacheDetail &imp, const GpuCacheEntry &entry)
+{
+  return (imp.last_transfer_event.isValid()) ? imp.last_transfer_event : entry.sync_event;
+}
+
+
+/// Write @p byte_count bytes from @p src into the cache buffer at @p offset . Unified memory is written directly once
+/// @p event - the most recent operation on the target memory - completes. Otherwise an asynchronous write is queued
+/// and tracked by @p event .
+void writeCacheMemory(GpuLayerCacheDetail &imp, const uint8_t *src, size_t byte_count, size_t offset,
+                      gputil::Queue &queue, gputil::Event *block_on, gputil::Event &event)
+{
+  if (imp.unified_mem)
+  {
+    if (block_on)
+    {
+      block_on->wait();
+    }
+    event.wait();
+    event.release();
+    std::memcpy(imp.unified_mem + offset, src, byte_count);
+    return;
+  }
+  flushForTransfer(imp, block_on);
+  imp.buffer->write(src, byte_count, offset, &queue, block_on, &event);
+  trackTransfer(imp, &queue, event);
+  if (imp.profiler)
+  {
+    imp.profiler->record(imp.upload_profile_name, event, byte_count);
+  }
+}
+
+
+/// Read @p byte_count bytes from the cache buffer at @p offset into @p dst after @p block_on completes. Unified memory
+/// is copied directly, leaving @p completion released. Otherwise the read is queued on @p queue (synchronous when
+/// null) and tracked by @p completion .
+size_t readCacheMemory(GpuLayerCacheDetail &imp, uint8_t *dst, size_t byte_count, size_t offset, gputil::Queue *queue,
+                       gputil::Event *block_on, gputil::Event *completion)
+{
+  if (imp.unified_mem)
+  {
+    if (block_on)
+    {
+      block_on->wait();
+    }
+    if (completion)
+    {
+      completion->release();
+    }
+    std::memcpy(dst, imp.unified_mem + offset, byte_count);
+    return byte_count;
+  }
+  flushForTransfer(imp, block_on);
+  const size_t read_bytes = imp.buffer->read(dst, byte_count, offset, queue, block_on, completion);
+  if (completion)
+  {
+    trackTransfer(imp, queue, *completion);
+    if (imp.profiler)
+    {
+      imp.profiler->record(imp.download_profile_name, *completion, read_bytes);
+    }
+  }
+  return read_bytes;
+}
+
+
+/// Unpack the packed voxel values at @p src into float voxels at @p dst .
+void unpackVoxels(const GpuLayerCacheDetail &imp, float *dst, const uint16_t *src)
+{
+  for (size_t i = 0; i < imp.chunk_voxel_count; ++i)
+  {
+    dst[i] = unpackOccupancy(int(int16_t(src[i])));
+  }
+}
+
+
+/// Complete a pending @c kGcfPackedOccupancy download for @p entry , unpacking the staged voxels to main memory.
+/// @p entry.sync_event must have completed.
+void completeUnpack(const GpuLayerCacheDetail &imp, GpuCacheEntry &entry)
+{
+  if (entry.unpack_pending)
+  {
+    entry.unpack_pending = false;
+    if (entry.voxel_buffer.isValid())
+    {
+      unpackVoxels(imp, reinterpret_cast<float *>(entry.voxel_buffer.voxelMemory()), entry.packed.data());
+    }
+  }
+}
+
+
+/// Write the voxels at @p src into the @c kGcfPackedOccupancy cache memory for @p entry , packing via the entry's
+/// staging memory. The staging memory may still be in use by a previous transfer, so we wait for @p entry to be idle.
+void writePackedCacheMemory(GpuLayerCacheDetail &imp, GpuCacheEntry &entry, const uint8_t *src, gputil::Queue &queue,
+                            gputil::Event *block_on)
+{
+  if (block_on)
+  {
+    block_on->wait();
+  }
+  entry.sync_event.wait();
+  completeUnpack(imp, entry);
+
+  entry.packed.resize(imp.chunk_mem_size / sizeof(uint16_t));
+  entry.packed_track.track(entry.packed);
+  const auto *voxels = reinterpret_cast<const float *>(src);
+  for (size_t i = 0; i < imp.chunk_voxel_count; ++i)
+  {
+    entry.packed[i] = uint16_t(packOccupancy(voxels[i]));
+  }
+
+  writeCacheMemory(imp, reinterpret_cast<const uint8_t *>(entry.packed.data()), imp.chunk_mem_size, entry.mem_offset,
+                   queue, nullptr, entry.sync_event);
+}
+
+
+/// Find the @c GpuLayerCacheDetail::region_table index for @p region_key or the first unused index in its probe
+/// sequence.
+size_t regionTableFind(const GpuLayerCacheDetail &imp, const glm::i16vec3 &region_key)
+{
+  const size_t mask = imp.region_table.size() - 1u;
+  size_t index = regionTableHash(region_key.x, region_key.y, region_key.z) & mask;
+  // The table is never full, so we always find the key or an unused entry.
+  while (imp.region_table[index].used)
+  {
+    const RegionTableEntry &entry = imp.region_table[index];
+    if (entry.region[0] == region_key.x && entry.region[1] == region_key.y && entry.region[2] == region_key.z)
+    {
+      break;
+    }
+    index = (index + 1u) & mask;
+  }
+  return index;
+}
+
+
+/// Add or update the region table entry mapping @p region_key to the cache memory at @p mem_offset .
+void regionTableInsert(GpuLayerCacheDetail &imp, const glm::i16vec3 &region_key, size_t mem_offset)
+{
+  if (imp.region_table.empty())
+  {
+    return;
+  }
+
+  RegionTableEntry &entry = imp.region_table[regionTableFind(imp, region_key)];
+  entry.region[0] = region_key.x;
+  entry.region[1] = region_key.y;
+  entry.region[2] = region_key.z;
+  entry.used = 1;
+  entry.slot = unsigned(mem_offset / imp.chunk_mem_size);
+  imp.region_table_dirty = true;
+}
+
+
+/// Remove @p region_key from the region table. Uses backward shift deletion to keep probe sequences intact without
+/// tombstones.
+void regionTableErase(GpuLayerCacheDetail &imp, const glm::i16vec3 &region_key)
+{
+  if (imp.region_table.empty())
+  {
+    return;
+  }
+
+  const size_t mask = imp.region_table.size() - 1u;
+  size_t hole = regionTableFind(imp, region_key);
+  if (!imp.region_table[hole].used)
+  {
+    return;
+  }
+
+  // Shift subsequent entries of the cluster back into the hole when doing so does not move them before their natural
+  // position.
+  size_t index = (hole + 1u) & mask;
+  while (imp.region_table[index].used)
+  {
+    const RegionTableEntry &entry = imp.region_table[index];
+    const size_t natural = regionTableHash(entry.region[0], entry.region[1], entry.region[2]) & mask;
+    // Probe distances from the natural position.
+    const size_t entry_distance = (index - natural) & mask;
+    const size_t hole_distance = (hole - natural) & mask;
+    if (hole_distance < entry_distance)
+    {
+      imp.region_table[hole] = entry;
+      hole = index;
+    }
+    index = (index + 1u) & mask;
+  }
+
+  imp.region_table[hole] = RegionTableEntry{};
+  imp.region_table_dirty = true;
+}
+
+
+/// Mark all region table entries as unused.
+void regionTableClear(GpuLayerCacheDetail &imp)
+{
+  if (!imp.region_table.empty())
+  {
+    std::fill(imp.region_table.begin(), imp.region_table.end(), RegionTableEntry{});
+    imp.region_table_dirty = true;
+  }
+}
+}  // namespace
+
+
 GpuLayerCache::GpuLayerCache(const gputil::Device &gpu, const gputil::Queue &gpu_queue, OccupancyMap &map,
                              unsigned layer_index, size_t target_gpu_mem_size, unsigned flags,
                              GpuCachePostSyncHandler on_sync)
@@ -159,7 +489,8 @@ unsigned GpuLayerCache::layerIndex() const
 size_t GpuLayerCache::allocate(OccupancyMap &map, const glm::i16vec3 &region_key, MapChunk *&chunk,
                                gputil::Event *event, CacheStatus *status, unsigned batch_marker, unsigned flags)
 {
-  GpuCacheEntry *entry = resolveCacheEntry(map, region_key, chunk, event, status, batch_marker, flags, false);
+  GpuCacheEntry *entry =
+    resolveCacheEntry(map, region_key, chunk, event, status, batch_marker, flags, false, transferQueue(*imp_));
   if (entry)
   {
     return entry->mem_offset;
@@ -172,7 +503,8 @@ size_t GpuLayerCache::allocate(OccupancyMap &map, const glm::i16vec3 &region_key
 size_t GpuLayerCache::upload(OccupancyMap &map, const glm::i16vec3 &region_key, MapChunk *&chunk, gputil::Event *event,
                              CacheStatus *status, unsigned batch_marker, unsigned flags)
 {
-  GpuCacheEntry *entry = resolveCacheEntry(map, region_key, chunk, event, status, batch_marker, flags, true);
+  GpuCacheEntry *entry =
+    resolveCacheEntry(map, region_key, chunk, event, status, batch_marker, flags, true, transferQueue(*imp_));
   if (entry)
   {
     return entry->mem_offset;
@@ -241,6 +573,24 @@ void GpuLayerCache::updateEvents(unsigned batch_marker, gputil::Event &event)
 }
 
 
+void GpuLayerCache::addDirtySpans(const std::shared_ptr<const GpuDirtySpanSet> &dirty_spans)
+{
+  if (!dirty_spans)
+  {
+    return;
+  }
+
+  for (unsigned i = 0; i < unsigned(dirty_spans->region_keys.size()); ++i)
+  {
+    GpuCacheEntry *entry = findCacheEntry(dirty_spans->region_keys[i]);
+    if (entry && entry->dirty_spans != kAllDirtySpans)
+    {
+      entry->pending_dirty_spans.emplace_back(dirty_spans, i);
+    }
+  }
+}
+
+
 void GpuLayerCache::remove(const glm::i16vec3 &region_key)
 {
   auto search_iter = imp_->cache.find(region_key);
@@ -253,6 +603,7 @@ void GpuLayerCache::remove(const glm::i16vec3 &region_key)
     // Push the memory offset onto the free list for re-use.
     imp_->mem_offset_free_list.push_back(entry.mem_offset);
     imp_->cache.erase(search_iter);
+    regionTableErase(*imp_, region_key);
   }
 }
 
@@ -311,6 +662,7 @@ void GpuLayerCache::syncToMainMemory()
   {
     GpuCacheEntry &entry = iter.second;
     entry.sync_event.wait();
+    completeUnpack(*imp_, entry);
     if (entry.chunk && imp_->on_sync)
     {
       imp_->on_sync(entry.chunk, imp_->region_size);
@@ -328,14 +680,24 @@ size_t GpuLayerCache::syncToExternal(uint8_t *dst, size_t dst_size, const glm::i
     GpuCacheEntry *entry = findCacheEntry(src_region_key);
     if (entry)
     {
-      if (entry->chunk && entry->voxel_buffer.isValid() && entry->voxel_buffer.voxelMemorySize() >= dst_size &&
-          !entry->skip_download)
+      const size_t host_size =
+        imp_->map->layout().layer(imp_->layer_index).layerByteSize(imp_->map->regionVoxelDimensions());
+      if ((entry->voxel_buffer.isValid() || entry->resident) && host_size >= dst_size && !entry->skip_download)
       {
         // Found a cached entry to sync.
         // Read voxel data, waiting on the chunk event to ensure it's up to date.
         // We use a synchronous copy to the destination location.
-        return imp_->buffer->read(dst, entry->voxel_buffer.voxelMemorySize(), entry->mem_offset, nullptr,
-                                  &entry->sync_event);
+        if (imp_->flags & kGcfPackedOccupancy)
+        {
+          std::vector<uint16_t> packed(imp_->chunk_mem_size / sizeof(uint16_t));
+          memorytrack::BufferTracker packed_track(MemorySubsystem::kGpuStaging);
+          packed_track.track(packed);
+          readCacheMemory(*imp_, reinterpret_cast<uint8_t *>(packed.data()), imp_->chunk_mem_size, entry->mem_offset,
+                          nullptr, &entry->sync_event, nullptr);
+          unpackVoxels(*imp_, reinterpret_cast<float *>(dst), packed.data());
+          return imp_->chunk_voxel_count * sizeof(float);
+        }
+        return readCacheMemory(*imp_, dst, host_size, entry->mem_offset, nullptr, &entry->sync_event, nullptr);
       }
     }
   }
@@ -354,6 +716,52 @@ size_t GpuLayerCache::syncToExternal(VoxelBuffer<VoxelBlock> &dst, const glm::i1
 }
 
 
+void GpuLayerCache::snapshot(GpuLayerSnapshot &snapshot, std::vector<gputil::Event> &events)
+{
+  snapshot.layer_index = int(imp_->layer_index);
+  snapshot.gpu_region_size = imp_->chunk_mem_size;
+  snapshot.region_voxel_count = imp_->chunk_voxel_count;
+  const MapLayer &layer = imp_->map->layout().layer(imp_->layer_index);
+  snapshot.host_region_size = layer.layerByteSize(imp_->map->regionVoxelDimensions());
+  snapshot.packed = (imp_->flags & kGcfPackedOccupancy) != 0;
+  snapshot.region_indices.clear();
+
+  // Size the memory first: it must not move once downloads are queued.
+  size_t region_count = 0;
+  for (const auto &iter : imp_->cache)
+  {
+    region_count += (iter.second.chunk || iter.second.resident) ? 1u : 0u;
+  }
+  if (snapshot.gpu_memory.size() < region_count * snapshot.gpu_region_size)
+  {
+    snapshot.gpu_memory.resize(region_count * snapshot.gpu_region_size);
+  }
+
+  for (auto &iter : imp_->cache)
+  {
+    GpuCacheEntry &entry = iter.second;
+    if (!entry.chunk && !entry.resident)
+    {
+      continue;
+    }
+
+    const size_t region_index = snapshot.region_indices.size();
+    snapshot.region_indices.emplace(entry.region_key, region_index);
+
+    // The download becomes the most recent operation on the entry, so later uploads and kernels wait on it.
+    gputil::Event last_event = entry.sync_event;
+    entry.sync_event.release();
+    readCacheMemory(*imp_, snapshot.gpu_memory.data() + region_index * snapshot.gpu_region_size, imp_->chunk_mem_size,
+                    entry.mem_offset, &transferQueue(*imp_), (last_event.isValid()) ? &last_event : nullptr,
+                    &entry.sync_event);
+    if (entry.sync_event.isValid())
+    {
+      events.emplace_back(entry.sync_event);
+    }
+  }
+}
+
+
 gputil::Device &GpuLayerCache::gpu()
 {
   return imp_->gpu;
@@ -378,6 +786,39 @@ const gputil::Queue &GpuLayerCache::gpuQueue() const
 }
 
 
+void GpuLayerCache::setTransferQueue(const gputil::Queue &queue)
+{
+  // Ensure outstanding transfers complete before we stop tracking them.
+  imp_->last_transfer_event.wait();
+  imp_->last_transfer_event.release();
+  imp_->transfer_queue = queue;
+}
+
+
+gputil::Queue &GpuLayerCache::transferQueue()
+{
+  return ohm::transferQueue(*imp_);
+}
+
+
+void GpuLayerCache::setProfiler(gputil::Profiler *profiler)
+{
+  imp_->profiler = profiler;
+  if (profiler)
+  {
+    const std::string layer_name = imp_->map->layout().layer(imp_->layer_index).name();
+    imp_->upload_profile_name = layer_name + " upload";
+    imp_->download_profile_name = layer_name + " download";
+  }
+}
+
+
+gputil::Profiler *GpuLayerCache::profiler() const
+{
+  return imp_->profiler;
+}
+
+
 unsigned GpuLayerCache::cachedCount() const
 {
   return unsigned(imp_->cache.size());
@@ -402,11 +843,84 @@ unsigned GpuLayerCache::chunkSize() const
 }
 
 
+bool GpuLayerCache::unifiedMemory() const
+{
+  return imp_->unified_mem != nullptr;
+}
+
+
+bool GpuLayerCache::packedOccupancy() const
+{
+  return (imp_->flags & kGcfPackedOccupancy) != 0;
+}
+
+
+bool GpuLayerCache::resident() const
+{
+  return (imp_->flags & kGcfResident) != 0;
+}
+
+
+bool GpuLayerCache::hasRegionTable() const
+{
+  return !imp_->region_table.empty();
+}
+
+
+unsigned GpuLayerCache::regionTableCapacity() const
+{
+  return unsigned(imp_->region_table.size());
+}
+
+
+gputil::Buffer *GpuLayerCache::regionTableBuffer() const
+{
+  return imp_->region_table_buffer.get();
+}
+
+
+void GpuLayerCache::syncRegionTable(gputil::Queue *queue, gputil::Event *completion)
+{
+  if (imp_->region_table.empty())
+  {
+    if (completion)
+    {
+      completion->release();
+    }
+    return;
+  }
+
+  if (imp_->region_table_dirty)
+  {
+    // The staging memory may still be in use by the previous upload.
+    imp_->region_table_upload_event.wait();
+    imp_->region_table_staging = imp_->region_table;
+    imp_->region_table_staging_track.track(imp_->region_table_staging);
+    imp_->region_table_buffer->write(imp_->region_table_staging.data(),
+                                     imp_->region_table_staging.size() * sizeof(RegionTableEntry), 0, queue, nullptr,
+                                     &imp_->region_table_upload_event);
+    imp_->region_table_dirty = false;
+  }
+
+  if (completion)
+  {
+    *completion = imp_->region_table_upload_event;
+  }
+}
+
+
 void GpuLayerCache::reallocate(const OccupancyMap &map)
+{
+  reallocate(map, imp_->target_gpu_mem_size);
+}
+
+
+void GpuLayerCache::reallocate(const OccupancyMap &map, size_t target_gpu_mem_size)
 {
   clear();
+  imp_->unified_mem = nullptr;
   imp_->buffer.reset(nullptr);
-  allocateBuffers(map, map.layout().layer(imp_->layer_index), imp_->target_gpu_mem_size);
+  allocateBuffers(map, map.layout().layer(imp_->layer_index), target_gpu_mem_size);
 }
 
 
@@ -418,7 +932,10 @@ void GpuLayerCache::clear()
     entry.second.sync_event.wait();
   }
   imp_->cache.clear();
-  imp_->stats.hits = imp_->stats.misses = imp_->stats.full;
+  imp_->mem_offset_free_list.clear();
+  regionTableClear(*imp_);
+  imp_->evictions_since_decay = 0;
+  imp_->stats = GpuCacheStats{};
 }
 
 void GpuLayerCache::queryStats(GpuCacheStats *stats)
@@ -426,22 +943,83 @@ void GpuLayerCache::queryStats(GpuCacheStats *stats)
   *stats = imp_->stats;
 }
 
+
+GpuLayerCacheEviction GpuLayerCache::evictionPolicy() const
+{
+  return imp_->eviction_policy;
+}
+
+
+void GpuLayerCache::setEvictionPolicy(GpuLayerCacheEviction policy)
+{
+  imp_->eviction_policy = policy;
+}
+
+
+void GpuLayerCache::setMotionHint(const glm::dvec3 &position, const glm::dvec3 &predicted_position)
+{
+  imp_->motion_start = position;
+  imp_->motion_end = predicted_position;
+  imp_->have_motion_hint = true;
+}
+
+
+void GpuLayerCache::clearMotionHint()
+{
+  imp_->have_motion_hint = false;
+}
+
+
+bool GpuLayerCache::prefetch(OccupancyMap &map, const glm::i16vec3 &region_key, gputil::Queue &queue)
+{
+  if (findCacheEntry(region_key))
+  {
+    // Already cached.
+    return false;
+  }
+
+  if (!map.region(region_key, false))
+  {
+    // Nothing to prefetch. The region will be created if required on upload.
+    return false;
+  }
+
+  MapChunk *chunk = nullptr;
+  CacheStatus status = kCacheFull;
+  // Use the current batch marker so we do not drop regions locked for the current batch, but never lock the region
+  // with it: it is not part of the batch.
+  const GpuCacheEntry *entry =
+    resolveCacheEntry(map, region_key, chunk, nullptr, &status, imp_->batch_marker, kSkipDownload, true, queue, true);
+  return entry != nullptr && status == kCacheNew;
+}
+
 GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i16vec3 &region_key, MapChunk *&chunk,
                                                 gputil::Event *event, CacheStatus *status, unsigned batch_marker,
-                                                unsigned flags, bool upload)
+                                                unsigned flags, bool upload, gputil::Queue &queue, bool prefetch)
 {
   const MapLayer &layer = map.layout().layer(imp_->layer_index);
   GpuCacheEntry *entry = findCacheEntry(region_key);
   if (entry)
   {
     ++imp_->stats.hits;
+    ++entry->use_count;
+    if (entry->prefetched)
+    {
+      ++imp_->stats.prefetch_hits;
+      entry->prefetched = false;
+    }
     // Already uploaded.
     chunk = entry->chunk;
     // Needs update?
     bool update_required = upload && (flags & kForceUpload) != 0;
 
     // Check if it was previously added, but without allowing creation.
-    if (!entry->chunk)
+    if (!entry->chunk && (imp_->flags & kGcfResident))
+    {
+      // The GPU memory is the backing store. Flag the entry as resident rather than creating the host chunk.
+      entry->resident = entry->resident || (flags & kAllowRegionCreate) != 0;
+    }
+    else if (!entry->chunk)
     {
       // First check if it's been created on CPU.
       entry->chunk = chunk = map.region(region_key, false);
@@ -466,6 +1044,12 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
     }
 
     entry->skip_download = entry->skip_download && ((flags & kSkipDownload) != 0);
+    if ((flags & (kSkipDownload | kDirtySpans)) == 0)
+    {
+      // Modifications will not be reported. Download the whole region.
+      entry->dirty_spans = kAllDirtySpans;
+      entry->pending_dirty_spans.clear();
+    }
 
     if (update_required)
     {
@@ -480,8 +1064,15 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
       }
       const uint8_t *voxel_mem =
         (entry->voxel_buffer.isValid()) ? entry->voxel_buffer.voxelMemory() : imp_->dummy_chunk;
-      imp_->buffer->write(voxel_mem, layer.layerByteSize(map.regionVoxelDimensions()), entry->mem_offset,
-                          &imp_->gpu_queue, wait_for_ptr, &entry->sync_event);
+      if (imp_->flags & kGcfPackedOccupancy)
+      {
+        writePackedCacheMemory(*imp_, *entry, voxel_mem, queue, wait_for_ptr);
+      }
+      else
+      {
+        writeCacheMemory(*imp_, voxel_mem, layer.layerByteSize(map.regionVoxelDimensions()), entry->mem_offset, queue,
+                         wait_for_ptr, entry->sync_event);
+      }
     }
     // We update the touched stamping even though the entry is already present and we may not need to upload anything.
     // We make the assumption that the request for a upload caching is being made because we are about to modify it.
@@ -493,7 +1084,8 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
         // Keeping in sync between GPU and CPU has been an ongoing issue. It probably needs a stamping system which
         // separates CPU and GPU changes, but we don't have that yet. As an interim solution to recognising GPU changes,
         // we update the dirty stamp for a chunk on both upload and download.
-        chunk->dirty_stamp = chunk->touched_stamps[imp_->layer_index] = entry->chunk_touch_stamp = imp_->map->stamp();
+        chunk->touched_stamps[imp_->layer_index] = entry->chunk_touch_stamp = imp_->map->stamp();
+        chunk->markDirty(entry->chunk_touch_stamp);
       }
       else
       {
@@ -503,7 +1095,7 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
 
     if (event)
     {
-      *event = entry->sync_event;
+      *event = dependencyEvent(*imp_, *entry);
     }
     if (status)
     {
@@ -518,12 +1110,20 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
     return entry;
   }
 
-  ++imp_->stats.misses;
+  if (prefetch)
+  {
+    ++imp_->stats.prefetches;
+  }
+  else
+  {
+    ++imp_->stats.misses;
+  }
 
   // Not in the cache yet.
   // Ensure the map chunk exists in the map if kAllowRegionCreate is set.
-  // Otherwise chunk may be null.
-  chunk = map.region(region_key, (flags & kAllowRegionCreate));
+  // Otherwise chunk may be null. Resident caches defer creation until the region is synchronised.
+  const bool resident = (imp_->flags & kGcfResident) != 0;
+  chunk = map.region(region_key, (flags & kAllowRegionCreate) && !resident);
 
   // Now add the chunk to the cache.
   // Check if there are unallocated buffers.
@@ -543,23 +1143,15 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
     }
     auto inserted = imp_->cache.insert(std::make_pair(region_key, new_entry));
     entry = &inserted.first->second;
+    regionTableInsert(*imp_, region_key, entry->mem_offset);
   }
   else
   {
     ++imp_->stats.full;
-    // Cache is full. Look for the oldest entry to sync back to main memory.
-    auto oldest_entry = imp_->cache.begin();
-    for (auto iter = imp_->cache.begin(); iter != imp_->cache.end(); ++iter)
-    {
-      // Check the age_stamp and the batch marker.
-      if (iter->second.age_stamp < oldest_entry->second.age_stamp &&
-          (batch_marker == 0 || iter->second.batch_marker != batch_marker))
-      {
-        oldest_entry = iter;
-      }
-    }
+    // Cache is full. Select an entry to sync back to main memory.
+    GpuCacheEntry *evict_entry = selectEviction(batch_marker);
 
-    if (batch_marker && oldest_entry != imp_->cache.end() && oldest_entry->second.batch_marker == batch_marker)
+    if (!evict_entry)
     {
       // All entries in the cache share the batch_marker. We cannot upload.
       if (status)
@@ -570,17 +1162,20 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
       return nullptr;
     }
 
-    // Synchronise the oldest entry back to main memory.
-    syncToMainMemory(oldest_entry->second, true);
+    // Synchronise the evicted entry back to main memory.
+    syncToMainMemory(*evict_entry, true);
 
     GpuCacheEntry new_entry{};
-    new_entry.mem_offset = oldest_entry->second.mem_offset;
-    // Remove oldest entry from the cache
-    imp_->cache.erase(oldest_entry);
+    new_entry.mem_offset = evict_entry->mem_offset;
+    // Remove the evicted entry from the cache
+    const glm::i16vec3 evict_key = evict_entry->region_key;
+    imp_->cache.erase(evict_key);
+    regionTableErase(*imp_, evict_key);
 
     // Insert the new entry.
     auto inserted = imp_->cache.insert(std::make_pair(region_key, new_entry));
     entry = &inserted.first->second;
+    regionTableInsert(*imp_, region_key, entry->mem_offset);
   }
 
   // Complete the cache entry.
@@ -589,25 +1184,36 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
   entry->voxel_buffer =
     (chunk) ? VoxelBuffer<VoxelBlock>(chunk->voxel_blocks[imp_->layer_index]) : VoxelBuffer<VoxelBlock>();
   entry->region_key = region_key;
+  entry->resident = resident && !chunk && (flags & kAllowRegionCreate);
   entry->age_stamp = imp_->age_stamp++;
-  if (batch_marker)
+  entry->use_count = (prefetch) ? 0u : 1u;
+  entry->prefetched = prefetch;
+  if (batch_marker && !prefetch)
   {
     // Update the batch marker.
     entry->batch_marker = batch_marker;
   }
   entry->skip_download = (flags & kSkipDownload);
+  entry->dirty_spans = ((flags & (kSkipDownload | kDirtySpans)) == 0) ? kAllDirtySpans : 0u;
 
   if (upload)
   {
     const uint8_t *voxel_mem = (entry->voxel_buffer.isValid()) ? entry->voxel_buffer.voxelMemory() : imp_->dummy_chunk;
-    imp_->buffer->write(voxel_mem, imp_->chunk_mem_size, entry->mem_offset, &imp_->gpu_queue, nullptr,
-                        &entry->sync_event);
+    if (imp_->flags & kGcfPackedOccupancy)
+    {
+      writePackedCacheMemory(*imp_, *entry, voxel_mem, queue, nullptr);
+    }
+    else
+    {
+      writeCacheMemory(*imp_, voxel_mem, imp_->chunk_mem_size, entry->mem_offset, queue, nullptr, entry->sync_event);
+    }
     if (chunk)
     {
       if (!entry->skip_download)
       {
         // As above where we upload to update, we change the stamp for the chunk on both upload and download.
-        chunk->dirty_stamp = chunk->touched_stamps[imp_->layer_index] = entry->chunk_touch_stamp = imp_->map->stamp();
+        chunk->touched_stamps[imp_->layer_index] = entry->chunk_touch_stamp = imp_->map->stamp();
+        chunk->markDirty(entry->chunk_touch_stamp);
       }
       else
       {
@@ -622,7 +1228,7 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
 
   if (event)
   {
-    *event = entry->sync_event;
+    *event = dependencyEvent(*imp_, *entry);
   }
   if (status)
   {
@@ -633,21 +1239,142 @@ GpuCacheEntry *GpuLayerCache::resolveCacheEntry(OccupancyMap &map, const glm::i1
 }
 
 
+GpuCacheEntry *GpuLayerCache::selectEviction(unsigned batch_marker)
+{
+  const auto can_evict = [batch_marker](const GpuCacheEntry &entry) {
+    return batch_marker == 0 || entry.batch_marker != batch_marker;
+  };
+
+  GpuLayerCacheEviction policy = imp_->eviction_policy;
+  if (policy == kGceMotion && !imp_->have_motion_hint)
+  {
+    policy = kGceLru;
+  }
+
+  GpuCacheEntry *evict_entry = nullptr;
+  switch (policy)
+  {
+  case kGceFrequency:
+    for (auto &iter : imp_->cache)
+    {
+      GpuCacheEntry &entry = iter.second;
+      if (can_evict(entry) &&
+          (!evict_entry || entry.use_count < evict_entry->use_count ||
+           (entry.use_count == evict_entry->use_count && entry.age_stamp < evict_entry->age_stamp)))
+      {
+        evict_entry = &entry;
+      }
+    }
+
+    // Decay the use counts each time the cache turns over, so old, heavily used regions can eventually be released.
+    if (++imp_->evictions_since_decay >= imp_->cache_size)
+    {
+      imp_->evictions_since_decay = 0;
+      for (auto &iter : imp_->cache)
+      {
+        iter.second.use_count >>= 1u;
+      }
+    }
+    break;
+
+  case kGceMotion:
+  {
+    // Score by the squared distance from the region centre to the motion hint segment. Regions behind the start of the
+    // segment have their score doubled so they are dropped before regions at a similar distance ahead.
+    const glm::dvec3 axis = imp_->motion_end - imp_->motion_start;
+    const double axis_length_sqr = glm::dot(axis, axis);
+    double evict_score = 0;
+    for (auto &iter : imp_->cache)
+    {
+      GpuCacheEntry &entry = iter.second;
+      if (!can_evict(entry))
+      {
+        continue;
+      }
+
+      const glm::dvec3 centre = imp_->map->regionSpatialCentre(entry.region_key);
+      const double t = (axis_length_sqr > 0) ? glm::dot(centre - imp_->motion_start, axis) / axis_length_sqr : 0.0;
+      const glm::dvec3 nearest = imp_->motion_start + std::max(0.0, std::min(t, 1.0)) * axis;
+      const glm::dvec3 separation = centre - nearest;
+      double score = glm::dot(separation, separation);
+      if (t < 0)
+      {
+        score *= 2.0;
+      }
+
+      if (!evict_entry || score > evict_score || (score == evict_score && entry.age_stamp < evict_entry->age_stamp))
+      {
+        evict_entry = &entry;
+        evict_score = score;
+      }
+    }
+    break;
+  }
+
+  case kGceLru:
+  default:
+    for (auto &iter : imp_->cache)
+    {
+      GpuCacheEntry &entry = iter.second;
+      if (can_evict(entry) && (!evict_entry || entry.age_stamp < evict_entry->age_stamp))
+      {
+        evict_entry = &entry;
+      }
+    }
+    break;
+  }
+
+  return evict_entry;
+}
+
+
 void GpuLayerCache::allocateBuffers(const OccupancyMap &map, const MapLayer &layer, size_t target_gpu_mem_size)
 {
   // Query maximum allocation size.
   auto mem_limit = imp_->gpu.maxAllocationSize();
   target_gpu_mem_size = (target_gpu_mem_size <= mem_limit) ? target_gpu_mem_size : mem_limit;
 
+  // Group member voxels are interleaved in the group layer, which the GPU code does not address.
+  if (layer.isGroupMember())
+  {
+    throw std::runtime_error("GPU layer cache does not support layer group members: " + std::string(layer.name()));
+  }
+
   imp_->target_gpu_mem_size = target_gpu_mem_size;
   imp_->region_size = layer.dimensions(map.regionVoxelDimensions());
   imp_->chunk_mem_size = layer.layerByteSize(map.regionVoxelDimensions());
+  imp_->chunk_voxel_count = size_t(imp_->region_size.x) * size_t(imp_->region_size.y) * size_t(imp_->region_size.z);
+
+  if (imp_->flags & kGcfPackedOccupancy)
+  {
+    if (layer.voxelByteSize() != sizeof(float))
+    {
+      throw std::runtime_error("Packed occupancy requires a float voxel layer: " + std::string(layer.name()));
+    }
+    // Two bytes per voxel, padded to whole 32-bit words so GPU code can update voxels using word atomics.
+    imp_->chunk_mem_size = ((imp_->chunk_voxel_count * sizeof(uint16_t) + 3u) / 4u) * 4u;
+  }
+
+  // Dirty spans are tracked in map region voxel indices, so we only support them when the layer is not subsampled.
+  // Packed occupancy always downloads whole regions.
+  imp_->dirty_span_size = 0;
+  const size_t region_volume = size_t(map.regionVoxelVolume());
+  if (!(imp_->flags & kGcfPackedOccupancy) && glm::ivec3(imp_->region_size) == map.regionVoxelDimensions() &&
+      region_volume && imp_->chunk_mem_size % region_volume == 0)
+  {
+    const size_t span_voxels = (region_volume + kDirtySpanCount - 1) / kDirtySpanCount;
+    imp_->dirty_span_size = span_voxels * (imp_->chunk_mem_size / region_volume);
+  }
 
   size_t allocated = 0;
 
   // Do loop to ensure we allocate at least one buffer.
   unsigned buffer_flags = gputil::kBfReadWrite;
-  if (imp_->flags & kGcfMappable)
+  if (imp_->flags & kGcfUnified)
+  {
+    buffer_flags |= gputil::kBfUnified;
+  }
+  else if (imp_->flags & kGcfMappable)
   {
     buffer_flags |= gputil::kBfHostAccess;
   }
@@ -661,30 +1388,127 @@ void GpuLayerCache::allocateBuffers(const OccupancyMap &map, const MapLayer &lay
   } while (allocated + imp_->chunk_mem_size <= target_gpu_mem_size);
 
   imp_->buffer = std::make_unique<gputil::Buffer>(imp_->gpu, allocated, buffer_flags);
+  // The unified flag is dropped from the buffer flags when the device cannot support it.
+  imp_->unified_mem = (imp_->buffer->flags() & gputil::kBfUnified) ?
+                        static_cast<uint8_t *>(imp_->buffer->hostPointer()) :
+                        nullptr;
 
+  delete[] imp_->dummy_chunk;
   imp_->dummy_chunk = new uint8_t[layer.layerByteSize(map.regionVoxelDimensions())];
   layer.clear(imp_->dummy_chunk, map.regionVoxelDimensions());
+
+  imp_->region_table_upload_event.wait();
+  imp_->region_table_upload_event.release();
+  imp_->region_table.clear();
+  imp_->region_table_buffer.reset();
+  if (imp_->flags & kGcfRegionTable)
+  {
+    // Keep the table at most half full.
+    size_t capacity = 16u;  // NOLINT(readability-magic-numbers)
+    while (capacity < 2u * size_t(imp_->cache_size))
+    {
+      capacity <<= 1u;
+    }
+    imp_->region_table.resize(capacity, RegionTableEntry{});
+    imp_->region_table_track.track(imp_->region_table);
+    imp_->region_table_buffer =
+      std::make_unique<gputil::Buffer>(imp_->gpu, capacity * sizeof(RegionTableEntry), gputil::kBfReadHost);
+    // Upload the empty table on the first sync.
+    imp_->region_table_dirty = true;
+  }
 }
 
 
 void GpuLayerCache::syncToMainMemory(GpuCacheEntry &entry, bool wait_on_sync)
 {
+  if (entry.resident && !entry.chunk && !entry.skip_download)
+  {
+    // Create the host shadow for a resident region. The new chunk holds default voxels, so the whole region must be
+    // downloaded.
+    entry.chunk = imp_->map->region(entry.region_key, true);
+    entry.voxel_buffer = VoxelBuffer<VoxelBlock>(entry.chunk->voxel_blocks[imp_->layer_index]);
+    entry.dirty_spans = kAllDirtySpans;
+    entry.resident = false;
+  }
+
   if (entry.chunk && !entry.skip_download)
   {
     // Cache the current sync event. We will make the memory copy depend on this event.
     gputil::Event last_event = entry.sync_event;
     // Release the entry's sync event. We will git it a new one.
     entry.sync_event.release();
+    // Merge reported dirty spans. The masks are read from GPU asynchronously so we must wait on them.
+    for (const auto &pending : entry.pending_dirty_spans)
+    {
+      pending.first->read_event.wait();
+      entry.dirty_spans |= pending.first->masks[pending.second];
+    }
+    entry.pending_dirty_spans.clear();
+
+    uint32_t dirty_spans = entry.dirty_spans;
+    entry.dirty_spans = 0;
+    if (imp_->dirty_span_size == 0)
+    {
+      dirty_spans = kAllDirtySpans;
+    }
+
+    if (dirty_spans == 0)
+    {
+      // Nothing modified on GPU. Restore the previous event so we still wait on outstanding operations.
+      entry.sync_event = last_event;
+      ++imp_->stats.skipped_syncs;
+    }
     // This should technically always be true if chunk is not null.
-    if (entry.voxel_buffer.isValid())
+    else if (entry.voxel_buffer.isValid())
     {
       // Queue memory read blocking on the last event and tracking a new one in entry.syncEvent
       uint8_t *voxel_mem = entry.voxel_buffer.voxelMemory();
-      imp_->buffer->read(voxel_mem, imp_->chunk_mem_size, entry.mem_offset, &imp_->gpu_queue, &last_event,
-                         &entry.sync_event);
+      if (imp_->flags & kGcfPackedOccupancy)
+      {
+        // Download into the staging memory. The voxels are unpacked once the read completes.
+        entry.packed.resize(imp_->chunk_mem_size / sizeof(uint16_t));
+        entry.packed_track.track(entry.packed);
+        readCacheMemory(*imp_, reinterpret_cast<uint8_t *>(entry.packed.data()), imp_->chunk_mem_size,
+                        entry.mem_offset, &transferQueue(*imp_), &last_event, &entry.sync_event);
+        entry.unpack_pending = true;
+      }
+      else if (dirty_spans == kAllDirtySpans)
+      {
+        readCacheMemory(*imp_, voxel_mem, imp_->chunk_mem_size, entry.mem_offset, &transferQueue(*imp_), &last_event,
+                        &entry.sync_event);
+      }
+      else
+      {
+        // Read each run of contiguous dirty spans. The queue is in order, so the last read event marks completion of
+        // all the reads.
+        ++imp_->stats.partial_syncs;
+        unsigned span = 0;
+        while (span < kDirtySpanCount)
+        {
+          if ((dirty_spans & (1u << span)) == 0)
+          {
+            ++span;
+            continue;
+          }
+
+          const unsigned run_start = span;
+          while (span < kDirtySpanCount && (dirty_spans & (1u << span)))
+          {
+            ++span;
+          }
+
+          const size_t byte_offset = run_start * imp_->dirty_span_size;
+          const size_t byte_end = std::min(span * imp_->dirty_span_size, imp_->chunk_mem_size);
+          if (byte_offset < byte_end)
+          {
+            readCacheMemory(*imp_, voxel_mem + byte_offset, byte_end - byte_offset, entry.mem_offset + byte_offset,
+                            &transferQueue(*imp_), &last_event, &entry.sync_event);
+          }
+        }
+      }
       // Update the dirty stamp for the region
-      entry.chunk->dirty_stamp = entry.chunk->touched_stamps[imp_->layer_index] = entry.chunk_touch_stamp =
-        imp_->map->touch();
+      entry.chunk->touched_stamps[imp_->layer_index] = entry.chunk_touch_stamp = imp_->map->touch();
+      entry.chunk->markDirty(entry.chunk_touch_stamp);
       // Also need to invalidate the MapChunk::first_valid_index as we don't know what it will be coming off the GPU.
       // We only apply this change for the occupancy layer
       if (imp_->layer_index == unsigned(imp_->map->layout().occupancyLayer()) ||
@@ -702,6 +1526,7 @@ void GpuLayerCache::syncToMainMemory(GpuCacheEntry &entry, bool wait_on_sync)
   {
     // Wait for operations to complete.
     entry.sync_event.wait();
+    completeUnpack(*imp_, entry);
     // Up to date.
     entry.skip_download = true;
 
@@ -9,6 +9,7 @@
 #include "OhmGpuConfig.h"
 
 #include "GpuCachePostSyncHandler.h"
+#include "GpuLayerCacheParams.h"
 
 #include <ohm/MapRegionCache.h>
 
@@ -16,13 +17,23 @@
 
 #include <gputil/gpuBuffer.h>
 #include <gputil/gpuDevice.h>
+#include <gputil/gpuEvent.h>
 #include <gputil/gpuQueue.h>
 
+#include <memory>
+#include <vector>
+
+namespace gputil
+{
+class Profiler;
+}  // namespace gputil
+
 namespace ohm
 {
 struct GpuCacheStats;
 struct GpuCacheEntry;
 struct GpuLayerCacheDetail;
+struct GpuLayerSnapshot;
 struct MapChunk;
 class MapLayer;
 class OccupancyMap;
@@ -30,6 +41,22 @@ class VoxelBlock;
 template <typename T>
 class VoxelBuffer;
 
+/// Dirty span masks for the regions updated by a GPU operation, read back from GPU. See
+/// @c GpuLayerCache::addDirtySpans() .
+struct ohmgpu_API GpuDirtySpanSet
+{
+  /// Keys of the regions updated. Corresponds to @c masks .
+  std::vector<glm::i16vec3> region_keys;
+  /// Modified span bit mask for each of the @c region_keys . Bit `i` is set when span `i` of the region voxels has been
+  /// modified. There are @c GpuLayerCache::kDirtySpanCount spans per region.
+  std::vector<uint32_t> masks;
+  /// Event marking completion of the GPU read into @c masks .
+  gputil::Event read_event;
+
+  /// Destructor. Waits on the @c read_event to ensure @c masks is not released while being written.
+  ~GpuDirtySpanSet();
+};
+
 /// Defines a GPU memory cache of voxel data.
 ///
 /// The cache may be used to ensure voxels from a @c MapChunk::voxel_maps associated with a @c MapLayer are uploaded
@@ -39,8 +66,13 @@ class VoxelBuffer;
 ///
 /// The GPU memory is allocated as a single, large memory buffer. Voxel data are uploaded to available regions within
 /// this buffer when calling @p upload(). The return value identified the byte offset into the buffer where data for
-/// the specific region are located. The region data persist in the cache as long as possible. The oldest region is
-/// dropped when @c upload() is called and the cache is full.
+/// the specific region are located. The region data persist in the cache as long as possible. When @c upload() is
+/// called and the cache is full, a region is dropped as selected by the @c evictionPolicy() . By default the least
+/// recently used region is dropped.
+///
+/// Regions may be uploaded ahead of use by calling @c prefetch() . This is intended to upload regions along a
+/// predicted sensor trajectory before they are required, typically on a separate copy queue - see
+/// @c GpuCache::prefetch() .
 ///
 /// Typical usage is as follows:
 /// - Start a batch with @c beginBatch()
@@ -80,8 +112,15 @@ public:
     kSkipDownload = (1u << 1u),
     /// Force upload even if already cached.
     kForceUpload = (1u << 2u),
+    /// Modifications made to the region by the pending GPU operation will be reported by @c addDirtySpans() .
+    /// Without this flag, the whole region is assumed to be modified unless @c kSkipDownload is also set.
+    kDirtySpans = (1u << 3u),
   };
 
+  /// Number of spans each region's voxels are divided into for dirty tracking. See @c addDirtySpans() .
+  /// Must match @c DIRTY_SPAN_COUNT in the GPU code.
+  static const unsigned kDirtySpanCount = 32;
+
   /// Create a new layer cache.
   ///
   /// This allocated a GPU buffer up to @c targetGpuMemSize bytes. The actual target allocation is a multiple of
@@ -229,6 +268,19 @@ public:
   /// @param event The most recent event to associate.
   void updateEvents(unsigned batch_marker, gputil::Event &event);
 
+  /// Report the voxel spans modified for regions uploaded with @c kDirtySpans .
+  ///
+  /// Synchronising a region to main memory after dirty span tracking only downloads the modified spans, or nothing
+  /// when no spans have been modified. The masks in @p dirty_spans need not be available yet; synchronisation waits on
+  /// the @c GpuDirtySpanSet::read_event before using them. The @p dirty_spans are retained until the regions are
+  /// synchronised.
+  ///
+  /// Dirty spans are only used when the layer has the same voxel dimensions as the map regions. Otherwise the whole
+  /// region is downloaded.
+  ///
+  /// @param dirty_spans The modified spans for a set of regions. Regions not in the cache are ignored.
+  void addDirtySpans(const std::shared_ptr<const GpuDirtySpanSet> &dirty_spans);
+
   /// Remove data associated with @p region_key from the cache.
   /// This will block until outstanding operations relating to @p chunk complete, but will not explicitly sync data
   /// back to the host.
@@ -293,6 +345,16 @@ public:
   /// @overload
   size_t syncToExternal(VoxelBuffer<VoxelBlock> &dst, const glm::i16vec3 &src_region_key);
 
+  /// Queue asynchronous downloads of all cached regions into @p snapshot without modifying main memory. This supports
+  /// @c GpuMap::syncVoxelsAsync() .
+  ///
+  /// The downloads wait on outstanding operations for each region and later GPU operations on the cache wait for the
+  /// downloads. The @p snapshot memory must not be modified until all the @p events complete.
+  ///
+  /// @param snapshot The layer snapshot to populate. Existing content is replaced.
+  /// @param[out] events Completion events for the downloads are appended here.
+  void snapshot(GpuLayerSnapshot &snapshot, std::vector<gputil::Event> &events);
+
   /// Access the GPU @c gputil::Device associated with GPU operations.
   /// @return The bound @c gputil::Device.
   gputil::Device &gpu();
@@ -305,6 +367,28 @@ public:
   /// @overload
   const gputil::Queue &gpuQueue() const;
 
+  /// Set a dedicated queue for cache uploads and downloads. Transfers then overlap work on the @c gpuQueue() with
+  /// event dependencies ordering the two. The events reported by @c upload() and @c allocate() cover all transfers
+  /// queued for this layer, so a kernel need only wait on the event for the last region it resolves.
+  ///
+  /// Pass an invalid queue to revert to transfers on the @c gpuQueue() .
+  /// @param queue The transfer queue.
+  void setTransferQueue(const gputil::Queue &queue);
+
+  /// Access the queue used for cache uploads and downloads. This is the @c gpuQueue() unless @c setTransferQueue()
+  /// has been called.
+  /// @return The transfer queue.
+  gputil::Queue &transferQueue();
+
+  /// Set the profiler with which to record device timing for cache uploads and downloads. The commands are recorded
+  /// as "<layer> upload" and "<layer> download" with the transferred byte count. The profiler must outlive this cache.
+  /// @param profiler The profiler to record to or null to disable profiling.
+  void setProfiler(gputil::Profiler *profiler);
+
+  /// Query the profiler set by @c setProfiler() .
+  /// @return The profiler or null when not profiling.
+  gputil::Profiler *profiler() const;
+
   /// Query the number of regions currently in the cache.
   /// @return The number of cached regions.
   unsigned cachedCount() const;
@@ -321,6 +405,49 @@ public:
   /// @return The byte size of each cached chunk in GPU.
   unsigned chunkSize() const;
 
+  /// Is the cache buffer allocated in unified memory? True when created with @c kGcfUnified and supported by the
+  /// device, in which case uploads and downloads are host side copies.
+  /// @return True when using unified memory.
+  bool unifiedMemory() const;
+
+  /// Does this cache store occupancy voxels as 16-bit fixed point? True when created with @c kGcfPackedOccupancy .
+  ///
+  /// The @c buffer() then holds two voxels per 32-bit word - see @c gpu/PackedOccupancy.h - and @c chunkSize() is
+  /// half the host layer size. Kernels must be built for the packed format.
+  /// @return True when using packed occupancy.
+  bool packedOccupancy() const;
+
+  /// Does this cache keep regions resident without a host mirror? True when created with @c kGcfResident .
+  ///
+  /// Regions created by GPU updates exist only in the cache @c buffer() until synchronised to main memory or evicted,
+  /// at which point the host @c MapChunk is created and populated.
+  /// @return True when in resident mode.
+  bool resident() const;
+
+  /// Does this cache maintain a region table? True when created with @c kGcfRegionTable .
+  ///
+  /// The region table is a device resident hash table mapping the key of each cached region to its slot in the cache
+  /// @c buffer() , allowing kernels to resolve any resident region without a per batch region list. See
+  /// @c gpu/RegionTable.h for the table format and device lookup.
+  /// @return True when using a region table.
+  bool hasRegionTable() const;
+
+  /// Query the number of entries in the region table. This is a power of two at least twice the @c cacheSize() .
+  /// @return The region table capacity or zero when @c hasRegionTable() is false.
+  unsigned regionTableCapacity() const;
+
+  /// Access the device copy of the region table, an array of @c regionTableCapacity() @c RegionTableEntry items.
+  /// The device copy is only updated by @c syncRegionTable() .
+  /// @return The region table buffer or null when @c hasRegionTable() is false.
+  gputil::Buffer *regionTableBuffer() const;
+
+  /// Upload the region table to the @c regionTableBuffer() if it has changed since the last sync. This should be
+  /// called after resolving the regions for a batch and before any kernel using the table.
+  /// @param queue Optional queue for an asynchronous upload. The upload is synchronous when null.
+  /// @param[out] completion Optional event set to mark completion of the most recent upload. Released when there is
+  ///   no region table.
+  void syncRegionTable(gputil::Queue *queue = nullptr, gputil::Event *completion = nullptr);
+
   /// Clear the cache then reallocate using the initial constraints. This should be called whenever the layout of
   /// the associated @c MapLayer changes, although this should be a rare occurrence.
   ///
@@ -330,6 +457,13 @@ public:
   /// @param map The map to which the @c GpuLayerCache belongs.
   void reallocate(const OccupancyMap &map);
 
+  /// Clear the cache then reallocate targeting a new GPU memory size. This supports growing or shrinking the cache to
+  /// meet a @c GpuMemoryArbiter budget. As with @c reallocate() , this does not @c syncToMainMemory() first.
+  ///
+  /// @param map The map to which the @c GpuLayerCache belongs.
+  /// @param target_gpu_mem_size The new maximum buffer size (bytes). See constructor notes.
+  void reallocate(const OccupancyMap &map, size_t target_gpu_mem_size);
+
   /// Drop all cache entries. Call @c syncToMainMemory() first if data should be synched first.
   /// Resets @c GpuCacheStats - see @c queryStats() .
   void clear() override;
@@ -338,12 +472,56 @@ public:
   /// @param[out] stats Populated to the current cache stats.
   void queryStats(GpuCacheStats *stats);
 
+  /// Query the policy used to select regions to drop from a full cache.
+  /// @return The current eviction policy.
+  GpuLayerCacheEviction evictionPolicy() const;
+
+  /// Set the policy used to select regions to drop from a full cache. Effective on the next eviction.
+  /// @param policy The new eviction policy.
+  void setEvictionPolicy(GpuLayerCacheEviction policy);
+
+  /// Set the motion hint used by @c kGceMotion . The hint is a line segment from the current sensor @p position to
+  /// the @p predicted_position . Regions are scored by their distance to this segment and the furthest region is
+  /// dropped first.
+  /// @param position The current sensor position.
+  /// @param predicted_position The predicted sensor position.
+  void setMotionHint(const glm::dvec3 &position, const glm::dvec3 &predicted_position);
+
+  /// Clear the motion hint. @c kGceMotion behaves as @c kGceLru until a new hint is set.
+  void clearMotionHint();
+
+  /// Upload the region at @p region_key ahead of use.
+  ///
+  /// The upload is queued on @p queue rather than the @c gpuQueue() , allowing the copy to overlap other GPU work. A
+  /// later @c upload() or @c allocate() for the region resolves to the prefetched entry, with the upload event
+  /// ensuring correct ordering.
+  ///
+  /// Nothing is done if the region is already cached or does not exist in @p map . The prefetch does not lock the
+  /// region using a batch marker and never drops regions locked by the current batch, so it may fail when the cache is
+  /// full of locked regions.
+  ///
+  /// Prefetch does not affect the cache hit/miss stats, but is tracked by @c GpuCacheStats::prefetches and
+  /// @c GpuCacheStats::prefetch_hits .
+  ///
+  /// @param map The map from which we are uploading data.
+  /// @param region_key The key for the region to upload.
+  /// @param queue The queue to upload on. Must belong to @c gpu() .
+  /// @return True if an upload has been queued for the region.
+  bool prefetch(OccupancyMap &map, const glm::i16vec3 &region_key, gputil::Queue &queue);
+
 private:
   /// Internal cache resolution/allocation function. The @p upload flag controls whether the call
-  /// just makes space for the chunk, or if it uploads data s well.
+  /// just makes space for the chunk, or if it uploads data s well. The @p queue is used for the upload and the
+  /// @p prefetch flag notes calls from @c prefetch() .
   GpuCacheEntry *resolveCacheEntry(OccupancyMap &map, const glm::i16vec3 &region_key, MapChunk *&chunk,
                                    gputil::Event *event, CacheStatus *status, unsigned batch_marker, unsigned flags,
-                                   bool upload);
+                                   bool upload, gputil::Queue &queue, bool prefetch = false);
+
+  /// Select an entry to drop from a full cache according to the @c evictionPolicy() . Entries with @p batch_marker
+  /// are not selected when @p batch_marker is non-zero.
+  /// @param batch_marker The current batch marker.
+  /// @return The entry to drop or null if there is no entry which can be dropped.
+  GpuCacheEntry *selectEviction(unsigned batch_marker);
 
   void allocateBuffers(const OccupancyMap &map, const MapLayer &layer, size_t target_gpu_mem_size);
 
@@ -23,11 +23,41 @@ enum GpuLayerCacheFlag : unsigned
   kGcfWrite = (1u << 1u),
   /// Using buffers mappable to host memory? Can result in faster data transfer.
   kGcfMappable = (1u << 2u),
+  /// Allocate the cache buffer in unified memory - fine grain SVM on OpenCL, mapped host memory on CUDA - so uploads
+  /// and downloads become host side copies rather than queued transfers. Ignored when the device does not support
+  /// unified buffers. Takes precedence over @c kGcfMappable .
+  kGcfUnified = (1u << 3u),
+  /// Maintain a device resident hash table mapping region keys to cache slots, so kernels may resolve any cached
+  /// region. See @c GpuLayerCache::syncRegionTable() and RegionTable.h.
+  kGcfRegionTable = (1u << 4u),
+  /// Store occupancy voxels in GPU memory as 16-bit fixed point, halving the memory per region. Host voxels remain
+  /// @c float and are converted on upload and download. Only valid for the occupancy layer. See PackedOccupancy.h.
+  kGcfPackedOccupancy = (1u << 5u),
+  /// Keep region voxels resident in GPU memory without a host mirror. Regions created by GPU updates are not created in
+  /// the @c OccupancyMap . Instead the host @c MapChunk is created when the region is synchronised to main memory -
+  /// see @c GpuLayerCache::syncToMainMemory() - or evicted from the cache. Host code must synchronise before accessing
+  /// the map.
+  kGcfResident = (1u << 6u),
 
   /// Default creation flags.
   kGcfDefaultFlags = kGcfRead | kGcfMappable
 };
 
+/// Policies used by a @c GpuLayerCache to select the region to drop from a full cache. Regions locked by the current
+/// batch marker are never dropped.
+enum GpuLayerCacheEviction : unsigned
+{
+  /// Drop the least recently used region.
+  kGceLru,
+  /// Drop the least frequently used region, breaking ties by the least recently used. Use counts are halved each time
+  /// the cache has turned over, so the counts favour recent usage.
+  kGceFrequency,
+  /// Drop the region furthest from the motion hint - see @c GpuLayerCache::setMotionHint() . Regions behind the
+  /// direction of travel are dropped first, keeping regions ahead of travel resident. Behaves as @c kGceLru until a
+  /// hint is set.
+  kGceMotion,
+};
+
 /// Parameters used in creating a @c GpuCacheLayer in @c GpuCache::createCache().
 struct ohmgpu_API GpuLayerCacheParams
 {
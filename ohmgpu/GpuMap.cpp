@@ -8,6 +8,7 @@
 #include "GpuCache.h"
 #include "GpuKey.h"
 #include "GpuLayerCache.h"
+#include "GpuMemoryArbiter.h"
 #include "GpuTransformSamples.h"
 #include "OhmGpu.h"
 #include "RayItem.h"
@@ -23,8 +24,11 @@
 #include <ohm/VoxelTouchTime.h>
 
 #include <ohmutil/GlmStream.h>
+#include <ohmutil/Profile.h>
+#include <ohmutil/TrajectoryIndex.h>
 
 #include "private/GpuMapDetail.h"
+#include "private/GpuMapSnapshotDetail.h"
 #include "private/GpuProgramRef.h"
 
 #include <ohm/private/OccupancyMapDetail.h>
@@ -34,28 +38,37 @@
 #include <gputil/gpuKernel.h>
 #include <gputil/gpuPinnedBuffer.h>
 #include <gputil/gpuPlatform.h>
+#include <gputil/gpuProfiler.h>
 #include <gputil/gpuProgram.h>
 
 #include <logutil/Logger.h>
 
 #include <glm/ext.hpp>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
 #include <functional>
 #include <initializer_list>
 #include <iostream>
+#include <memory>
+#include <utility>
 
 /// Enable to verify ray sorting pushes unclipped samples to the begining of the list.
 #define OHM_GPU_VERIFY_SORT 0
 
 #if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "RegionEnumerateResource.h"
 #include "RegionUpdateResource.h"
 #endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
 
 #if GPUTIL_TYPE == GPUTIL_CUDA
 GPUTIL_CUDA_DECLARE_KERNEL(regionRayUpdateOccupancy);
+GPUTIL_CUDA_DECLARE_KERNEL(regionRayUpdateOccupancyAggregate);
+GPUTIL_CUDA_DECLARE_KERNEL(regionRayUpdateOccupancyPacked);
+GPUTIL_CUDA_DECLARE_KERNEL(regionRayUpdateOccupancyAggregatePacked);
+GPUTIL_CUDA_DECLARE_KERNEL(regionEnumerate);
 #endif  // GPUTIL_TYPE == GPUTIL_CUDA
 
 namespace ohm
@@ -66,12 +79,25 @@ namespace
 // NOLINTNEXTLINE(cert-err58-cpp)
 GpuProgramRef g_program_ref("RegionUpdate", GpuProgramRef::kSourceString, RegionUpdateCode,  // NOLINT
                             RegionUpdateCode_length);
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_packed("RegionUpdate", GpuProgramRef::kSourceString, RegionUpdateCode,  // NOLINT
+                                   RegionUpdateCode_length, { "-DOCCUPANCY_PACKED" });
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_enumerate("RegionEnumerate", GpuProgramRef::kSourceString,  // NOLINT
+                                      RegionEnumerateCode, RegionEnumerateCode_length);
 #else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
 // NOLINTNEXTLINE(cert-err58-cpp)
 GpuProgramRef g_program_ref("RegionUpdate", GpuProgramRef::kSourceFile, "RegionUpdate.cl");  // NOLINT
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_packed("RegionUpdate", GpuProgramRef::kSourceFile, "RegionUpdate.cl", 0u,
+                                   { "-DOCCUPANCY_PACKED" });
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_enumerate("RegionEnumerate", GpuProgramRef::kSourceFile, "RegionEnumerate.cl");  // NOLINT
 #endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
 
 const double kDefaultMaxRayRange = 1000.0;
+/// Number of entries in the hash set used to deduplicate region keys on GPU. Must be a power of 2.
+const unsigned kRegionWalkSetCapacity = 4096u;
 
 #if OHM_GPU_VERIFY_SORT
 /// Verify that rays are sorted such that all unclipped samples come first.
@@ -99,6 +125,215 @@ unsigned verifySort(const std::vector<RayItem> &rays)
   return failure_count;
 }
 #endif  // OHM_GPU_VERIFY_SORT
+
+/// Build the coherence sort key for @p ray : the region containing the ray origin in z, y, x order of significance
+/// followed by the ray direction octant. Region key axes are offset to be non-negative, each occupying 16 bits.
+inline uint64_t coherentSortKey(const RayItem &ray)
+{
+  const glm::i16vec3 region = ray.origin_key.regionKey();
+  const uint64_t region_bits = uint64_t(uint16_t(region.x + 0x8000)) |          //
+                               (uint64_t(uint16_t(region.y + 0x8000)) << 16u) |  //
+                               (uint64_t(uint16_t(region.z + 0x8000)) << 32u);
+  const glm::dvec3 dir = ray.sample - ray.origin;
+  const uint64_t octant = uint64_t(dir.x < 0) | (uint64_t(dir.y < 0) << 1u) | (uint64_t(dir.z < 0) << 2u);
+  return (region_bits << 3u) | octant;
+}
+
+
+/// Sort @p rays by @c coherentSortKey() using a stable, least significant digit radix sort on 8-bit digits. Digits
+/// which are the same for all rays - such as the upper bits of the region key - are skipped.
+///
+/// @param rays The rays to sort.
+/// @param keys Working buffer for the sort keys.
+/// @param scratch Working buffer for the radix sort.
+/// @param sorted Working buffer used to reorder @p rays . Swapped with @p rays on completion.
+void sortRaysCoherent(std::vector<RayItem> &rays, std::vector<std::pair<uint64_t, unsigned>> &keys,
+                      std::vector<std::pair<uint64_t, unsigned>> &scratch, std::vector<RayItem> &sorted)
+{
+  if (rays.size() < 2)
+  {
+    return;
+  }
+
+  keys.resize(rays.size());
+  scratch.resize(rays.size());
+  uint64_t key_or = 0;
+  uint64_t key_and = ~uint64_t(0);
+  for (size_t i = 0; i < rays.size(); ++i)
+  {
+    keys[i] = std::make_pair(coherentSortKey(rays[i]), unsigned(i));
+    key_or |= keys[i].first;
+    key_and &= keys[i].first;
+  }
+
+  // Bits which differ between keys. Only these digits need sorting.
+  const uint64_t varying_bits = key_or ^ key_and;
+  const unsigned digit_bits = 8u;
+  const unsigned key_bits = 51u;  // 3 * 16 bits region + 3 bits octant.
+  const uint64_t digit_max = (1u << digit_bits) - 1u;
+  std::array<size_t, 1u << digit_bits> histogram{};
+  for (unsigned shift = 0; shift < key_bits; shift += digit_bits)
+  {
+    if ((varying_bits & (digit_max << shift)) == 0)
+    {
+      continue;
+    }
+
+    histogram.fill(0);
+    for (const auto &key : keys)
+    {
+      ++histogram[(key.first >> shift) & digit_max];
+    }
+
+    size_t offset = 0;
+    for (size_t &count : histogram)
+    {
+      const size_t digit_count = count;
+      count = offset;
+      offset += digit_count;
+    }
+
+    for (const auto &key : keys)
+    {
+      scratch[histogram[(key.first >> shift) & digit_max]++] = key;
+    }
+    keys.swap(scratch);
+  }
+
+  sorted.resize(rays.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    sorted[i] = rays[keys[i].second];
+  }
+  rays.swap(sorted);
+}
+
+
+/// Record the region uploads and update kernel for the batch in @p buffer_index with the @p gpu_cache profiler (if
+/// any) then mark the end of the batch. Must be called after queuing the batch kernel.
+void releaseRegionWalkProgram(GpuMapDetail &imp)
+{
+  imp.region_walk_kernel = gputil::Kernel();
+  if (imp.region_walk_program_ref)
+  {
+    imp.region_walk_program_ref->releaseReference(imp.region_walk_gpu);
+    imp.region_walk_program_ref = nullptr;
+  }
+}
+
+
+bool cacheRegionWalkProgram(GpuMapDetail &imp, gputil::Device &gpu)
+{
+  if (imp.region_walk_program_ref && imp.region_walk_gpu == gpu)
+  {
+    return imp.region_walk_kernel.isValid();
+  }
+
+  releaseRegionWalkProgram(imp);
+  if (!g_program_ref_enumerate.addReference(gpu))
+  {
+    return false;
+  }
+
+  imp.region_walk_program_ref = &g_program_ref_enumerate;
+  imp.region_walk_gpu = gpu;
+  imp.region_walk_kernel = GPUTIL_MAKE_KERNEL(g_program_ref_enumerate.program(gpu), regionEnumerate);
+  imp.region_walk_kernel.calculateOptimalWorkGroupSize();
+  imp.region_walk_set = gputil::Buffer(gpu, sizeof(uint64_t) * kRegionWalkSetCapacity, gputil::kBfReadWrite);
+  imp.region_walk_keys = gputil::Buffer(gpu, sizeof(GpuKey) * 1024u, gputil::kBfReadWriteHost);
+  imp.region_walk_count = gputil::Buffer(gpu, sizeof(uint32_t), gputil::kBfReadWriteHost);
+  return imp.region_walk_kernel.isValid();
+}
+
+
+/// Enumerate the regions touched by the rays uploaded to the @p buffer_index buffer set on GPU, adding them to
+/// @c GpuMapDetail::regions . Blocks until the results are available.
+bool walkRegionsGpu(GpuMapDetail &imp, GpuCache &gpu_cache, int buffer_index, unsigned ray_count)
+{
+  if (!cacheRegionWalkProgram(imp, gpu_cache.gpu()))
+  {
+    return false;
+  }
+
+  const OccupancyMap &map = *imp.map;
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+  const gputil::int3 region_dim_gpu = { region_dim.x, region_dim.y, region_dim.z };
+
+  gputil::Queue &queue = gpu_cache.gpuQueue();
+  gputil::Dim3 global_size(ray_count);
+  gputil::Dim3 local_size(std::min<size_t>(imp.region_walk_kernel.optimalWorkGroupSize(), ray_count));
+  gputil::Event kernel_event;
+
+  // Run the kernel, resizing and running again if the region keys overflow.
+  uint32_t region_count = 0;
+  for (int attempt = 0; attempt < 2; ++attempt)
+  {
+    const uint64_t empty = 0u;
+    const uint32_t zero = 0u;
+    gputil::Event clear_set_event;
+    gputil::Event clear_count_event;
+    imp.region_walk_set.fill(&empty, sizeof(empty), &queue, nullptr, &clear_set_event);
+    imp.region_walk_count.write(&zero, sizeof(zero), 0, &queue, nullptr, &clear_count_event);
+    const auto max_regions = unsigned(imp.region_walk_keys.elementCount<GpuKey>());
+
+    gputil::EventList wait({ imp.key_upload_events[buffer_index], imp.ray_upload_events[buffer_index],
+                             clear_set_event, clear_count_event });
+    const int err = imp.region_walk_kernel(
+      global_size, local_size, wait, kernel_event, &queue,
+      // Kernel args begin:
+      gputil::BufferArg<GpuKey>(imp.key_buffers[buffer_index]),
+      gputil::BufferArg<gputil::float3>(imp.ray_buffers[buffer_index]), ray_count, region_dim_gpu,
+      float(map.resolution()), gputil::BufferArg<uint64_t>(imp.region_walk_set), kRegionWalkSetCapacity,
+      gputil::BufferArg<GpuKey>(imp.region_walk_keys), max_regions, gputil::BufferArg<uint32_t>(imp.region_walk_count));
+    if (err)
+    {
+      return false;
+    }
+
+    imp.region_walk_count.read(&region_count, sizeof(region_count), 0, nullptr, &kernel_event);
+    if (region_count <= max_regions)
+    {
+      break;
+    }
+
+    imp.region_walk_keys.elementsResize<GpuKey>(region_count);
+  }
+
+  region_count = std::min(region_count, uint32_t(imp.region_walk_keys.elementCount<GpuKey>()));
+  imp.region_walk_results.resize(region_count);
+  imp.region_walk_keys.read(imp.region_walk_results.data(), region_count * sizeof(GpuKey), 0, nullptr,
+                            &kernel_event);
+
+  for (const GpuKey &key : imp.region_walk_results)
+  {
+    const glm::i16vec3 region_key(key.region[0], key.region[1], key.region[2]);
+    if (!imp.region_filter || imp.region_filter(region_key))
+    {
+      imp.regions.insert(region_key);
+    }
+  }
+
+  return true;
+}
+
+
+void profileBatch(GpuMapDetail &imp, GpuCache &gpu_cache, int buffer_index)
+{
+  gputil::Profiler *profiler = gpu_cache.profiler();
+  if (!profiler)
+  {
+    return;
+  }
+
+  profiler->record("region key upload", imp.region_key_upload_events[buffer_index],
+                   imp.region_key_buffers[buffer_index].size());
+  for (const VoxelUploadInfo &upload_info : imp.voxel_upload_info[buffer_index])
+  {
+    profiler->record("region offset upload", upload_info.offset_upload_event, upload_info.offsets_buffer.size());
+  }
+  profiler->record("region update", imp.region_update_events[buffer_index]);
+  profiler->endBatch();
+}
 }  // namespace
 
 namespace gpumap
@@ -122,6 +357,19 @@ GpuCache *enableGpu(OccupancyMap &map, size_t target_gpu_mem_size, unsigned flag
 }
 
 
+GpuCache *enableGpu(OccupancyMap &map, const gputil::Device &gpu, size_t target_gpu_mem_size, unsigned flags)
+{
+  OccupancyMapDetail &map_imp = *map.detail();
+  if (map_imp.gpu_cache)
+  {
+    return static_cast<GpuCache *>(map_imp.gpu_cache);
+  }
+
+  initialiseGpuCache(map, gpu, target_gpu_mem_size, flags);
+  return static_cast<GpuCache *>(map_imp.gpu_cache);
+}
+
+
 void sync(OccupancyMap &map)
 {
   if (GpuCache *cache = gpuCache(map))
@@ -271,12 +519,15 @@ GpuMap::GpuMap(GpuMapDetail *detail, unsigned expected_element_count, size_t gpu
 
 GpuMap::GpuMap(OccupancyMap *map, bool borrowed_map, unsigned expected_element_count, size_t gpu_mem_size)
   : GpuMap(new GpuMapDetail(map, borrowed_map), expected_element_count, gpu_mem_size)
-{}
+{
+  imp_->track_dirty_spans = true;
+}
 
 
 GpuMap::~GpuMap()
 {
   GpuMap::releaseGpuProgram();
+  releaseRegionWalkProgram(*imp_);
   delete imp_;
 }
 
@@ -307,7 +558,8 @@ bool GpuMap::borrowedMap() const
 
 void GpuMap::syncVoxels()
 {
-  const int sync_index = (imp_->next_buffers_index + 1) % GpuMapDetail::kBuffersCount;
+  flushStream();
+  const int sync_index = imp_->previousBufferIndex(imp_->next_buffers_index);
   if (imp_->map)
   {
     // TODO(KS): split the logic for starting synching and waiting on completion.
@@ -326,8 +578,10 @@ void GpuMap::syncVoxels()
 
 void GpuMap::syncVoxels(const std::vector<int> &layer_indices)
 {
+  PROFILE(GpuMap_syncVoxels);
   // Sync layers specified in layer_indices. Supports map copy functions.
-  const int sync_index = (imp_->next_buffers_index + 1) % GpuMapDetail::kBuffersCount;
+  flushStream();
+  const int sync_index = imp_->previousBufferIndex(imp_->next_buffers_index);
   auto *cache = gpuCache();
   if (imp_->map)
   {
@@ -345,9 +599,46 @@ void GpuMap::syncVoxels(const std::vector<int> &layer_indices)
 }
 
 
+std::shared_ptr<GpuMapSnapshot> GpuMap::syncVoxelsAsync()
+{
+  flushStream();
+
+  imp_->snapshot_index = (imp_->snapshot_index + 1) % unsigned(imp_->snapshots.size());
+  std::shared_ptr<GpuMapSnapshot> &snapshot = imp_->snapshots[imp_->snapshot_index];
+  if (!snapshot || snapshot.use_count() > 1)
+  {
+    // The previous snapshot in this slot is still in use. Leave it to the reader.
+    snapshot = std::make_shared<GpuMapSnapshot>();
+  }
+
+  GpuMapSnapshotDetail &snapshot_imp = *snapshot->detail();
+  snapshot_imp.reset();
+  GpuCache *cache = gpuCache();
+  if (imp_->map && cache)
+  {
+    snapshot_imp.stamp = imp_->map->stamp();
+    const int sync_index = imp_->previousBufferIndex(imp_->next_buffers_index);
+    for (const auto &voxel_info : imp_->voxel_upload_info[sync_index])
+    {
+      GpuLayerCache *layer_cache = cache->layerCache(voxel_info.gpu_layer_id);
+      if (layer_cache && !voxel_info.skip_cpu_sync)
+      {
+        layer_cache->snapshot(snapshot_imp.layer(int(layer_cache->layerIndex())), snapshot_imp.events);
+      }
+    }
+  }
+  snapshot_imp.complete = false;
+
+  return snapshot;
+}
+
+
 void GpuMap::setRayFilter(const RayFilterFunction &ray_filter)
 {
+  // Pending stream rays are filtered on submission, so must be submitted with the current filter.
+  flushStream();
   imp_->ray_filter = ray_filter;
+  imp_->ray_batch_filter = nullptr;
   imp_->custom_ray_filter = true;
 }
 
@@ -364,9 +655,36 @@ const RayFilterFunction &GpuMap::effectiveRayFilter() const
 }
 
 
+void GpuMap::setRayBatchFilter(const RayBatchFilterFunction &ray_batch_filter)
+{
+  flushStream();
+  if (!imp_->custom_ray_filter && imp_->map)
+  {
+    // Keep the map's per ray filter for callers of effectiveRayFilter() .
+    imp_->ray_filter = imp_->map->rayFilter();
+  }
+  imp_->ray_batch_filter = ray_batch_filter;
+  imp_->custom_ray_filter = true;
+}
+
+
+const RayBatchFilterFunction &GpuMap::rayBatchFilter() const
+{
+  return imp_->ray_batch_filter;
+}
+
+
+const RayBatchFilterFunction &GpuMap::effectiveRayBatchFilter() const
+{
+  return (imp_->custom_ray_filter || !imp_->map) ? imp_->ray_batch_filter : imp_->map->rayBatchFilter();
+}
+
+
 void GpuMap::clearRayFilter()
 {
+  flushStream();
   imp_->ray_filter = nullptr;
+  imp_->ray_batch_filter = nullptr;
   imp_->custom_ray_filter = false;
 }
 
@@ -407,6 +725,129 @@ void GpuMap::setRaySegmentLength(double length)
 }
 
 
+bool GpuMap::coherentRays() const
+{
+  return imp_->coherent_rays;
+}
+
+
+bool GpuMap::gpuRegionWalk() const
+{
+  return imp_->gpu_region_walk;
+}
+
+
+void GpuMap::setGpuRegionWalk(bool enable)
+{
+  imp_->gpu_region_walk = enable;
+}
+
+
+void GpuMap::setCoherentRays(bool enable)
+{
+  imp_->coherent_rays = enable;
+}
+
+
+unsigned GpuMap::pipelineDepth() const
+{
+  return imp_->buffers_count;
+}
+
+
+void GpuMap::setPipelineDepth(unsigned depth)
+{
+  depth = std::max(2u, std::min(depth, unsigned(GpuMapDetail::kMaxBuffersCount)));
+  if (depth == imp_->buffers_count)
+  {
+    return;
+  }
+
+  // Drain the pipeline before changing the buffer rotation.
+  flushStream();
+  for (int i = 0; i < int(imp_->buffers_count); ++i)
+  {
+    waitOnPreviousOperation(i);
+  }
+
+  imp_->buffers_count = depth;
+  imp_->next_buffers_index = 0;
+}
+
+
+unsigned GpuMap::maxPipelineDepth()
+{
+  return GpuMapDetail::kMaxBuffersCount;
+}
+
+
+bool GpuMap::aggregateUpdates() const
+{
+  return imp_->aggregate_updates;
+}
+
+
+void GpuMap::setAggregateUpdates(bool enable)
+{
+  imp_->aggregate_updates = enable;
+}
+
+
+unsigned GpuMap::streamBatchSize() const
+{
+  return imp_->stream_batch_size;
+}
+
+
+void GpuMap::setStreamBatchSize(unsigned element_count)
+{
+  flushStream();
+  imp_->stream_batch_size = element_count;
+  if (element_count)
+  {
+    imp_->stream_rays.reserve(element_count);
+  }
+}
+
+
+size_t GpuMap::pendingStreamCount() const
+{
+  return imp_->stream_rays.size();
+}
+
+
+size_t GpuMap::flushStream()
+{
+  if (imp_->stream_rays.empty())
+  {
+    return 0u;
+  }
+
+  const size_t integrated_count =
+    integrateRays(imp_->stream_rays.data(), imp_->stream_rays.size(),
+                  (imp_->stream_intensities_valid) ? imp_->stream_intensities.data() : nullptr,
+                  (imp_->stream_timestamps_valid) ? imp_->stream_timestamps.data() : nullptr, imp_->stream_flags,
+                  effectiveRayFilter(), effectiveRayBatchFilter());
+
+  imp_->stream_rays.clear();
+  imp_->stream_intensities.clear();
+  imp_->stream_timestamps.clear();
+  return integrated_count;
+}
+
+
+const GpuMap::RegionFilterFunction &GpuMap::regionFilter() const
+{
+  return imp_->region_filter;
+}
+
+
+void GpuMap::setRegionFilter(const RegionFilterFunction &filter)
+{
+  imp_->region_filter = filter;
+}
+
+
 bool GpuMap::groupedRays() const
 {
   return imp_->group_rays;
@@ -416,7 +857,169 @@ bool GpuMap::groupedRays() const
 size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
                              const double *timestamps, unsigned region_update_flags)
 {
-  return integrateRays(rays, element_count, intensities, timestamps, region_update_flags, effectiveRayFilter());
+  if (!imp_->stream_batch_size)
+  {
+    return integrateRays(rays, element_count, intensities, timestamps, region_update_flags, effectiveRayFilter(),
+                         effectiveRayBatchFilter());
+  }
+
+  if (!imp_->gpu_ok)
+  {
+    return 0u;
+  }
+
+  // Stream batching. Submit the pending rays first if they cannot be combined with the new rays.
+  if (!imp_->stream_rays.empty() &&
+      (region_update_flags != imp_->stream_flags || imp_->stream_intensities_valid != (intensities != nullptr) ||
+       imp_->stream_timestamps_valid != (timestamps != nullptr)))
+  {
+    flushStream();
+  }
+
+  if (imp_->stream_rays.empty())
+  {
+    imp_->stream_flags = region_update_flags;
+    imp_->stream_intensities_valid = intensities != nullptr;
+    imp_->stream_timestamps_valid = timestamps != nullptr;
+  }
+
+  const size_t ray_count = element_count / 2;
+  imp_->stream_rays.insert(imp_->stream_rays.end(), rays, rays + ray_count * 2);
+  if (intensities)
+  {
+    imp_->stream_intensities.insert(imp_->stream_intensities.end(), intensities, intensities + ray_count);
+  }
+  if (timestamps)
+  {
+    imp_->stream_timestamps.insert(imp_->stream_timestamps.end(), timestamps, timestamps + ray_count);
+  }
+
+  if (imp_->stream_rays.size() >= imp_->stream_batch_size)
+  {
+    flushStream();
+  }
+
+  return ray_count * 2;
+}
+
+
+size_t GpuMap::integrateLocalRays(const double *transform_times, const glm::dvec3 *transform_translations,
+                                  const glm::dquat *transform_rotations, size_t transform_count,
+                                  const double *sample_times, const glm::dvec3 *local_samples, size_t sample_count,
+                                  unsigned region_update_flags, double max_range)
+{
+  PROFILE(GpuMap_integrateLocalRays);
+  if (!imp_->map || !imp_->gpu_ok)
+  {
+    return 0u;
+  }
+
+  // Maintain ordering with respect to any pending stream batch.
+  flushStream();
+
+  OccupancyMap &map = *imp_->map;
+  GpuCache *gpu_cache = gpumap::enableGpu(map);
+
+  if (!gpu_cache || sample_count == 0 || transform_count == 0)
+  {
+    return 0u;
+  }
+
+  cacheGpuProgram(imp_->support_voxel_mean && map.voxelMeanEnabled(), imp_->support_traversal && map.traversalEnabled(),
+                  false);
+
+  const int buf_idx = imp_->next_buffers_index;
+
+  map.touch();
+
+  GpuTransformRaysTarget target;
+  target.map = &map;
+  target.line_keys = &imp_->key_buffers[buf_idx];
+  target.local_lines = &imp_->ray_buffers[buf_idx];
+  target.original_lines = (imp_->use_original_ray_buffers) ? &imp_->original_ray_buffers[buf_idx] : nullptr;
+  target.max_range = max_range;
+  if (map.layout().layerIndex(default_layer::touchTimeLayerName()) >= 0)
+  {
+    target.touch_timebase = map.updateFirstRayTime(*sample_times);
+    target.touch_times = &imp_->timestamps_buffers[buf_idx];
+    region_update_flags |= kRfInternalTimestamps;
+  }
+
+  GpuLayerCache *layer_cache = gpu_cache->layerCache(kGcIdOccupancy);
+  if (!layer_cache)
+  {
+    layer_cache = gpu_cache->layerCache(kGcIdTsdf);
+  }
+  if (!layer_cache)
+  {
+    logutil::error("GpuMap cannot resolve occupancy or TSDF layer.\n");
+    return 0u;
+  }
+  imp_->batch_marker = layer_cache->beginBatch();
+
+  if (!imp_->transform_samples)
+  {
+    imp_->transform_samples = new GpuTransformSamples(gpu_cache->gpu());
+  }
+
+  // Wait for the last batch using this buffer set before the transform overwrites its buffers.
+  waitOnPreviousOperation(buf_idx);
+
+  // The transform kernel writes directly into this buffer set. Its completion event stands in for all the ray upload
+  // events.
+  const unsigned ray_count = imp_->transform_samples->transformRays(
+    transform_times, transform_translations, transform_rotations, unsigned(transform_count), sample_times,
+    local_samples, unsigned(sample_count), gpu_cache->gpuQueue(), target, imp_->transformed_regions,
+    imp_->key_upload_events[buf_idx]);
+
+  imp_->ray_upload_events[buf_idx] = imp_->key_upload_events[buf_idx];
+  if (target.original_lines)
+  {
+    imp_->original_ray_upload_events[buf_idx] = imp_->key_upload_events[buf_idx];
+  }
+  if (target.touch_times)
+  {
+    imp_->timestamps_upload_events[buf_idx] = imp_->key_upload_events[buf_idx];
+  }
+  if (ray_count && map.layout().intensityLayer() >= 0)
+  {
+    // Intensities are not supported. Provide zero values for kernels which expect them.
+    const float zero = 0.0f;
+    imp_->intensities_buffers[buf_idx].elementsResize<float>(ray_count);
+    imp_->intensities_buffers[buf_idx].fill(&zero, sizeof(zero), &gpu_cache->gpuQueue(), nullptr,
+                                            &imp_->intensities_upload_events[buf_idx]);
+  }
+
+  imp_->ray_counts[buf_idx] = ray_count;
+  imp_->unclipped_sample_counts[buf_idx] = ray_count;
+
+  if (ray_count == 0)
+  {
+    return 0u;
+  }
+
+  imp_->regions.clear();
+  for (const glm::i16vec3 &region_key : imp_->transformed_regions)
+  {
+    if (imp_->regions.find(region_key) == imp_->regions.end() &&
+        (!imp_->region_filter || imp_->region_filter(region_key)))
+    {
+      imp_->regions.insert(region_key);
+    }
+  }
+
+  enqueueRegions(buf_idx, region_update_flags);
+
+  return ray_count;
+}
+
+
+size_t GpuMap::integrateLocalRays(const TrajectoryIndex &trajectory, const double *sample_times,
+                                  const glm::dvec3 *local_samples, size_t sample_count, unsigned region_update_flags,
+                                  double max_range)
+{
+  return integrateLocalRays(trajectory.times(), trajectory.positions(), trajectory.rotations(), trajectory.count(),
+                            sample_times, local_samples, sample_count, region_update_flags, max_range);
 }
 
 
@@ -451,7 +1054,8 @@ void GpuMap::setMap(OccupancyMap *map, bool borrowed_map, unsigned expected_elem
     GpuCache &gpu_cache = *gpumap::enableGpu(*imp_->map, gpu_mem_size, gpumap::kGpuAllowMappedBuffers);
 
     const unsigned prealloc_region_count = 1024u;
-    for (unsigned i = 0; i < GpuMapDetail::kBuffersCount; ++i)
+    // Allocate all buffer sets so the pipeline depth may be changed without reallocating.
+    for (unsigned i = 0; i < GpuMapDetail::kMaxBuffersCount; ++i)
     {
       imp_->key_buffers[i] =
         gputil::Buffer(gpu_cache.gpu(), sizeof(GpuKey) * expected_element_count, gputil::kBfReadHost);
@@ -468,6 +1072,8 @@ void GpuMap::setMap(OccupancyMap *map, bool borrowed_map, unsigned expected_elem
         gputil::Buffer(gpu_cache.gpu(), sizeof(uint32_t) * expected_element_count, gputil::kBfReadHost);
       imp_->region_key_buffers[i] =
         gputil::Buffer(gpu_cache.gpu(), sizeof(gputil::int3) * prealloc_region_count, gputil::kBfReadHost);
+      imp_->dirty_span_buffers[i] =
+        gputil::Buffer(gpu_cache.gpu(), sizeof(uint32_t) * prealloc_region_count, gputil::kBfReadWriteHost);
 
       // Add structures for managing uploads of regino offsets to the cache buffer.
       imp_->occupancy_uidx = int(imp_->voxel_upload_info[i].size());  // Set twice to the same value, but that's ok.
@@ -488,9 +1094,14 @@ void GpuMap::setGroupedRays(bool group)
 
 void GpuMap::cacheGpuProgram(bool with_voxel_mean, bool with_traversal, bool force)
 {
+  // The occupancy cache memory format selects the program variant.
+  const GpuLayerCache *occupancy_cache = gpuCache()->layerCache(kGcIdOccupancy);
+  const bool packed = occupancy_cache && occupancy_cache->packedOccupancy();
+  GpuProgramRef *program_ref = (packed) ? &g_program_ref_packed : &g_program_ref;
+
   if (imp_->program_ref)
   {
-    if (!force && with_voxel_mean == imp_->cached_sub_voxel_program)
+    if (!force && with_voxel_mean == imp_->cached_sub_voxel_program && imp_->program_ref == program_ref)
     {
       return;
     }
@@ -507,13 +1118,33 @@ void GpuMap::cacheGpuProgram(bool with_voxel_mean, bool with_traversal, bool for
   GpuCache &gpu_cache = *gpuCache();
   imp_->gpu_ok = true;
   imp_->cached_sub_voxel_program = with_voxel_mean;
-  imp_->program_ref = &g_program_ref;
+  imp_->program_ref = program_ref;
+  imp_->program_gpu = gpu_cache.gpu();
 
-  if (imp_->program_ref->addReference(gpu_cache.gpu()))
+  if (imp_->program_ref->addReference(imp_->program_gpu))
   {
-    imp_->update_kernel = GPUTIL_MAKE_KERNEL(imp_->program_ref->program(), regionRayUpdateOccupancy);
+    gputil::Program &program = imp_->program_ref->program(imp_->program_gpu);
+    if (packed)
+    {
+      imp_->update_kernel = GPUTIL_MAKE_KERNEL(program, regionRayUpdateOccupancyPacked);
+      imp_->aggregate_update_kernel = GPUTIL_MAKE_KERNEL(program, regionRayUpdateOccupancyAggregatePacked);
+    }
+    else
+    {
+      imp_->update_kernel = GPUTIL_MAKE_KERNEL(program, regionRayUpdateOccupancy);
+      imp_->aggregate_update_kernel = GPUTIL_MAKE_KERNEL(program, regionRayUpdateOccupancyAggregate);
+    }
     imp_->update_kernel.calculateOptimalWorkGroupSize();
     imp_->gpu_ok = imp_->update_kernel.isValid();
+
+    if (imp_->aggregate_update_kernel.isValid())
+    {
+      // Local memory for the aggregation table keys and the adjustment/traversal value pairs.
+      const size_t slot_count = size_t(1u) << GpuMapDetail::kAggregateSlotBits;
+      imp_->aggregate_update_kernel.addLocal([slot_count](size_t) { return sizeof(uint32_t) * slot_count; });
+      imp_->aggregate_update_kernel.addLocal([slot_count](size_t) { return 2 * sizeof(float) * slot_count; });
+      imp_->aggregate_update_kernel.calculateOptimalWorkGroupSize();
+    }
   }
   else
   {
@@ -529,17 +1160,24 @@ void GpuMap::releaseGpuProgram()
     imp_->update_kernel = gputil::Kernel();
   }
 
+  if (imp_ && imp_->aggregate_update_kernel.isValid())
+  {
+    imp_->aggregate_update_kernel = gputil::Kernel();
+  }
+
   if (imp_ && imp_->program_ref)
   {
-    imp_->program_ref->releaseReference();
+    imp_->program_ref->releaseReference(imp_->program_gpu);
     imp_->program_ref = nullptr;
   }
 }
 
 
 size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
-                             const double *timestamps, unsigned region_update_flags, const RayFilterFunction &filter)
+                             const double *timestamps, unsigned region_update_flags, const RayFilterFunction &filter,
+                             const RayBatchFilterFunction &batch_filter)
 {
+  PROFILE(GpuMap_integrateRays);
   if (!imp_->map)
   {
     return 0u;
@@ -563,6 +1201,16 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
     return 0u;
   }
 
+  if (gpu_cache->memoryBudgetPending())
+  {
+    // The GPU memory arbiter has changed the cache budget. Drain the pipeline before reallocating the layer caches.
+    for (int i = 0; i < int(imp_->buffers_count); ++i)
+    {
+      waitOnPreviousOperation(i);
+    }
+    gpu_cache->applyMemoryBudget();
+  }
+
   // Drop intensity and timestamps if we do not have the map layers to support it. This saves on uploading unnecesary
   // GPU data.
   if (map.layout().intensityLayer() < 0)
@@ -580,9 +1228,9 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
 
   // Resolve the buffer index to use. We need to support cases where buffer is already one fo the imp_->ray_buffers.
   // Check this first.
-  // We still need a buffer index for event tracking.
+  // We still need a buffer index for event tracking. We defer waiting on the previous use of this buffer set until
+  // after CPU side ray preparation, so that preparation overlaps the batches still in flight.
   const int buf_idx = imp_->next_buffers_index;
-  waitOnPreviousOperation(buf_idx);
 
   // Touch the map to update stamping.
   map.touch();
@@ -611,7 +1259,8 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
   // affected by a ray.
   const auto region_func = [this](const glm::i16vec3 &region_key, const glm::dvec3 & /*origin*/,
                                   const glm::dvec3 & /*sample*/) {
-    if (imp_->regions.find(region_key) == imp_->regions.end())
+    if (imp_->regions.find(region_key) == imp_->regions.end() &&
+        (!imp_->region_filter || imp_->region_filter(region_key)))
     {
       imp_->regions.insert(region_key);
     }
@@ -624,17 +1273,12 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
   gputil::PinnedBuffer intensities_pinned;
   gputil::PinnedBuffer timestamps_pinned;
 
-  // Build region set and upload rays.
-  imp_->regions.clear();
-
   std::array<gputil::float3, 2> ray_gpu;
   unsigned uploaded_ray_count = 0u;
   unsigned unclipped_samples = 0u;
   GpuKey line_start_key_gpu{};
   GpuKey line_end_key_gpu{};
 
-  const bool use_filter = bool(filter);
-
   // We have two loops we could run:
   // 1. processing rays as is
   // 2. grouping rays by sample voxel
@@ -698,7 +1342,6 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
     // logutil::trace(i / 2, ' ', imp_->map->voxelKey(rays[i + 0]), " -> ", imp_->map->voxelKey(rays[i + 1]), ' ',
     //                 ray_start, ':', ray_end, "  <=>  ", rays[i + 0], " -> ", rays[i + 1], '\n');
     // logutil::trace("dirs: ", (ray_end - ray_start), " vs ", (ray_end_d - ray_start_d), '\n');
-    gpumap::walkRegions(*imp_->map, ray.origin, ray.sample, region_func);
   };
 
   const RayUploadFunc upload_ray_with_intensity_or_timestamp = [&](const RayItem &ray)  //
@@ -722,28 +1365,35 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
   imp_->grouped_rays.clear();
   imp_->grouped_rays.reserve(element_count / 2);
 
-  // Take the input rays and move it into imp_->grouped_rays. In this process we do two things:
-  // 1. Apply the ray filter (if any). This can change the origin and/or sample points.
-  // 2. Break up long rays into multiple grouped_rays entries
+  // Apply the ray filter (if any) as a separate pass. This can change the origin and/or sample points.
+  imp_->filtered_rays.assign(rays, rays + (element_count & ~size_t(1u)));
+  imp_->filter_flags.resize(element_count / 2);
+  filterRays(imp_->filtered_rays.data(), imp_->filter_flags.data(), element_count / 2, batch_filter, filter);
+  // Resolve the keys for the filtered points in one pass. Only the last part of a segmented ray needs to recalculate.
+  imp_->filtered_keys.resize(imp_->filtered_rays.size());
+  map.voxelKeys(imp_->filtered_rays.data(), imp_->filtered_rays.size(), imp_->filtered_keys.data());
+
+  // Take the filtered rays and move them into imp_->grouped_rays, breaking up long rays into multiple grouped_rays
+  // entries.
   const double resolution = imp_->map->resolution();
   RayItem ray{};
-  for (unsigned i = 0; i < element_count; i += 2)
+  for (unsigned i = 0; i + 1 < element_count; i += 2)
   {
-    ray.original_origin = ray.origin = rays[i + 0];
-    ray.original_sample = ray.sample = rays[i + 1];
-    ray.intensity = (intensities) ? intensities[i >> 1] : 0;
-    ray.timestamp = (timestamps) ? encodeVoxelTouchTime(timebase, timestamps[i >> 1]) : 0;
-    ray.filter_flags = 0;
-
-    if (use_filter)
+    ray.filter_flags = imp_->filter_flags[i >> 1];
+    if (ray.filter_flags & kRffInvalid)
     {
-      if (!filter(&ray.origin, &ray.sample, &ray.filter_flags))
-      {
-        // Bad ray.
-        continue;
-      }
+      // Bad ray.
+      continue;
     }
 
+    ray.original_origin = rays[i + 0];
+    ray.original_sample = rays[i + 1];
+    ray.origin = imp_->filtered_rays[i + 0];
+    ray.sample = imp_->filtered_rays[i + 1];
+    ray.intensity = (intensities) ? intensities[i >> 1] : 0;
+    ray.timestamp = (timestamps) ? encodeVoxelTouchTime(timebase, timestamps[i >> 1]) : 0;
+    bool segmented = false;
+
     if (imp_->ray_segment_length > resolution)
     {
       // ray_length starts as a squared value.
@@ -791,12 +1441,13 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
         ray.filter_flags |= last_part_clipped_end;
         ray.origin = ray.sample;
         ray.sample = sample;
+        segmented = true;
       }
     }
 
     // This always adds either the full, unsegmented ray, or the last part for a segmented ray.
-    ray.origin_key = map.voxelKey(ray.origin);
-    ray.sample_key = map.voxelKey(ray.sample);
+    ray.origin_key = (segmented) ? map.voxelKey(ray.origin) : imp_->filtered_keys[i + 0];
+    ray.sample_key = imp_->filtered_keys[i + 1];
 
     imp_->grouped_rays.emplace_back(ray);
   }
@@ -811,6 +1462,25 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
     verifySort(imp_->grouped_rays);
 #endif  // OHM_GPU_VERIFY_SORT
   }
+  else if (imp_->coherent_rays)
+  {
+    sortRaysCoherent(imp_->grouped_rays, imp_->ray_sort_keys, imp_->ray_sort_scratch, imp_->sorted_rays);
+  }
+
+  // Build the region set. This has no dependency on the GPU buffers. With GPU region walking, the set is built after
+  // the upload instead.
+  imp_->regions.clear();
+  if (!imp_->gpu_region_walk)
+  {
+    for (const RayItem &grouped_ray : imp_->grouped_rays)
+    {
+      gpumap::walkRegions(*imp_->map, grouped_ray.origin, grouped_ray.sample, region_func);
+    }
+  }
+
+  // Wait for the last batch using this buffer set to complete before we overwrite its buffers. Other batches may still
+  // be in flight.
+  waitOnPreviousOperation(buf_idx);
 
   // Reserve GPU memory for the rays.
   imp_->key_buffers[buf_idx].resize(sizeof(GpuKey) * 2 * imp_->grouped_rays.size());
@@ -839,6 +1509,13 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
     timestamps_pinned = gputil::PinnedBuffer(imp_->timestamps_buffers[buf_idx], gputil::kPinWrite);
   }
 
+  // Batch buffers are not part of the GpuCache budget. Report them separately.
+  if (!imp_->memory_consumer.isValid())
+  {
+    imp_->memory_consumer = GpuMemoryConsumer(GpuMemoryArbiter::forDevice(gpu_cache->gpu()), "GpuMap", 0u, 0u);
+  }
+  imp_->memory_consumer.reportUsage(imp_->batchMemorySize());
+
   // Upload to GPU.
   for (const RayItem &ray : imp_->grouped_rays)
   {
@@ -861,6 +1538,28 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
     timestamps_pinned.unpin(&gpu_cache->gpuQueue(), nullptr, &imp_->timestamps_upload_events[buf_idx]);
   }
 
+  if (gputil::Profiler *profiler = gpu_cache->profiler())
+  {
+    profiler->record("ray key upload", imp_->key_upload_events[buf_idx], sizeof(GpuKey) * 2 * uploaded_ray_count);
+    profiler->record("ray upload", imp_->ray_upload_events[buf_idx],
+                     sizeof(gputil::float3) * 2 * uploaded_ray_count);
+    if (imp_->use_original_ray_buffers)
+    {
+      profiler->record("ray upload", imp_->original_ray_upload_events[buf_idx],
+                       sizeof(gputil::float3) * 2 * uploaded_ray_count);
+    }
+    if (intensities)
+    {
+      profiler->record("ray data upload", imp_->intensities_upload_events[buf_idx],
+                       sizeof(float) * uploaded_ray_count);
+    }
+    if (timestamps)
+    {
+      profiler->record("ray data upload", imp_->timestamps_upload_events[buf_idx],
+                       sizeof(uint32_t) * uploaded_ray_count);
+    }
+  }
+
   imp_->ray_counts[buf_idx] = uploaded_ray_count;
   imp_->unclipped_sample_counts[buf_idx] = unclipped_samples;
 
@@ -869,6 +1568,15 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
     return 0u;
   }
 
+  if (imp_->gpu_region_walk && !walkRegionsGpu(*imp_, *gpu_cache, buf_idx, uploaded_ray_count))
+  {
+    // Fall back to walking the regions on CPU.
+    for (const RayItem &grouped_ray : imp_->grouped_rays)
+    {
+      gpumap::walkRegions(*imp_->map, grouped_ray.origin, grouped_ray.sample, region_func);
+    }
+  }
+
   enqueueRegions(buf_idx, region_update_flags);
 
   return uploaded_ray_count * 2;
@@ -877,6 +1585,7 @@ size_t GpuMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const
 
 void GpuMap::waitOnPreviousOperation(int buffer_index)
 {
+  PROFILE(GpuMap_waitOnPreviousOperation);
   // Wait first on the event known to complete last.
   imp_->region_update_events[buffer_index].wait();
   imp_->region_update_events[buffer_index].release();
@@ -899,6 +1608,7 @@ void GpuMap::waitOnPreviousOperation(int buffer_index)
 
 void GpuMap::enqueueRegions(int buffer_index, unsigned region_update_flags)
 {
+  PROFILE(GpuMap_enqueueRegions);
   // For each region we need to enqueue the voxel data for that region. Within the GpuCache, each GpuLayerCache
   // manages the voxel data for a voxel layer and uploads into a single buffer for that layer returning an offset into
   // that buffer. For each (relevant) layer, we need to record the memory offset and upload corresponding event. These
@@ -929,6 +1639,10 @@ void GpuMap::enqueueRegions(int buffer_index, unsigned region_update_flags)
         regions_buffer.write(&gpu_region_key, sizeof(gpu_region_key),
                              imp_->region_counts[buffer_index] * sizeof(gpu_region_key));
         ++imp_->region_counts[buffer_index];
+        if (imp_->track_dirty_spans)
+        {
+          imp_->batch_region_keys[buffer_index].emplace_back(region_key);
+        }
         break;  // Break the tries loop into the outer loop.
       }
 
@@ -945,6 +1659,7 @@ void GpuMap::enqueueRegions(int buffer_index, unsigned region_update_flags)
         if (imp_->region_counts[buffer_index])
         {
           finaliseBatch(region_update_flags);
+          profileBatch(*imp_, gpu_cache, buffer_index);
         }
 
         // Because we are reusing the same rays buffer, we need to cache the following two events and restore them
@@ -954,7 +1669,7 @@ void GpuMap::enqueueRegions(int buffer_index, unsigned region_update_flags)
 
         // Since our cache memory is full, we should wait for all operations to complete as we may need a clear cache.
         // We re-use the same buffer_index to avoid copying ray data.
-        for (int i = 0; i < int(GpuMapDetail::kBuffersCount); ++i)
+        for (int i = 0; i < int(imp_->buffers_count); ++i)
         {
           waitOnPreviousOperation(i);
         }
@@ -993,6 +1708,7 @@ void GpuMap::enqueueRegions(int buffer_index, unsigned region_update_flags)
   }
 
   finaliseBatch(region_update_flags);
+  profileBatch(*imp_, gpu_cache, buffer_index);
 }
 
 
@@ -1011,6 +1727,7 @@ bool GpuMap::enqueueRegion(const glm::i16vec3 &region_key, int buffer_index)
     unsigned cache_flags = 0;
     cache_flags |= voxel_info.allow_region_creation * GpuLayerCache::kAllowRegionCreate;
     cache_flags |= voxel_info.skip_cpu_sync * GpuLayerCache::kSkipDownload;
+    cache_flags |= imp_->track_dirty_spans * GpuLayerCache::kDirtySpans;
     auto mem_offset = uint64_t(layer_cache.upload(*imp_->map, region_key, chunk, &voxel_info.voxel_upload_event,
                                                   &status, imp_->batch_marker, cache_flags));
 
@@ -1075,12 +1792,17 @@ void GpuMap::finaliseBatch(unsigned region_update_flags)
   // Enqueue update kernel.
   const gputil::int3 region_dim_gpu = { map->region_voxel_dimensions.x, map->region_voxel_dimensions.y,
                                         map->region_voxel_dimensions.z };
+  const unsigned voxel_order_gpu = unsigned(imp_->map->voxelOrder());
 
   const unsigned region_count = imp_->region_counts[buf_idx];
   const unsigned ray_count = imp_->ray_counts[buf_idx];
+  // Aggregation cannot support stopping on the first occupied voxel as it defers the voxel updates.
+  const bool aggregate = imp_->aggregate_updates && imp_->aggregate_update_kernel.isValid() &&
+                         (region_update_flags & kRfStopOnFirstOccupied) == 0;
+  gputil::Kernel &update_kernel = (aggregate) ? imp_->aggregate_update_kernel : imp_->update_kernel;
   int next_upload_buffer = 0;
   gputil::Dim3 global_size(ray_count);
-  gputil::Dim3 local_size(std::min<size_t>(imp_->update_kernel.optimalWorkGroupSize(), ray_count));
+  gputil::Dim3 local_size(std::min<size_t>(update_kernel.optimalWorkGroupSize(), ray_count));
   gputil::EventList wait({ imp_->key_upload_events[buf_idx], imp_->ray_upload_events[buf_idx],
                            imp_->region_key_upload_events[buf_idx],
                            imp_->voxel_upload_info[buf_idx][next_upload_buffer].offset_upload_event,
@@ -1125,9 +1847,23 @@ void GpuMap::finaliseBatch(unsigned region_update_flags)
     ++next_upload_buffer;
   }
 
+  // Clear the dirty span masks for the kernel to populate.
+  std::shared_ptr<GpuDirtySpanSet> dirty_spans;
+  if (imp_->track_dirty_spans)
+  {
+    dirty_spans = std::make_shared<GpuDirtySpanSet>();
+    dirty_spans->region_keys.swap(imp_->batch_region_keys[buf_idx]);
+    dirty_spans->masks.resize(region_count);
+    imp_->dirty_span_buffers[buf_idx].elementsResize<uint32_t>(region_count);
+    const uint32_t zero = 0u;
+    gputil::Event clear_event;
+    imp_->dirty_span_buffers[buf_idx].fill(&zero, sizeof(zero), &gpu_cache.gpuQueue(), nullptr, &clear_event);
+    wait.add(clear_event);
+  }
+
   // Supporting voxel mean and traversal are putting us at the limit of what we can support using this sort of
   // conditional invocation.
-  imp_->update_kernel(
+  update_kernel(
     global_size, local_size, wait, imp_->region_update_events[buf_idx], &gpu_cache.gpuQueue(),
     // Kernel args begin:
     // Occupancy voxels and offsets.
@@ -1158,11 +1894,25 @@ void GpuMap::finaliseBatch(unsigned region_update_flags)
     // Input touch times buffer
     gputil::BufferArg<uint32_t>((region_update_flags & kRfInternalTimestamps) ? &imp_->timestamps_buffers[buf_idx] :
                                                                                 nullptr),
-    // Region dimensions, map resolution, ray adjustment (miss), sample adjustment (hit)
-    region_dim_gpu, float(map->resolution), map->miss_value, map->hit_value,
+    // Output dirty span masks
+    gputil::BufferArg<uint32_t>(dirty_spans ? &imp_->dirty_span_buffers[buf_idx] : nullptr),
+    // Region dimensions, voxel order, map resolution, ray adjustment (miss), sample adjustment (hit)
+    region_dim_gpu, voxel_order_gpu, float(map->resolution), map->miss_value, map->hit_value,
     // Occupied threshold, min occupancy, max occupancy, update flags.
     map->occupancy_threshold_value, map->min_voxel_value, map->max_voxel_value, region_update_flags);
 
+  if (dirty_spans)
+  {
+    // Read back the dirty spans asynchronously. The layer caches wait on the read before each region sync.
+    imp_->dirty_span_buffers[buf_idx].read(dirty_spans->masks.data(), sizeof(uint32_t) * region_count, 0,
+                                           &gpu_cache.gpuQueue(), &imp_->region_update_events[buf_idx],
+                                           &dirty_spans->read_event);
+    for (const VoxelUploadInfo &voxel_info : imp_->voxel_upload_info[buf_idx])
+    {
+      gpu_cache.layerCache(voxel_info.gpu_layer_id)->addDirtySpans(dirty_spans);
+    }
+  }
+
   // Update most recent chunk GPU event.
   occupancy_layer_cache.updateEvents(imp_->batch_marker, imp_->region_update_events[buf_idx]);
   if (mean_layer_cache)
@@ -1187,7 +1937,7 @@ void GpuMap::finaliseBatch(unsigned region_update_flags)
   {
     traversal_layer_cache->beginBatch(imp_->batch_marker);
   }
-  imp_->next_buffers_index = (imp_->next_buffers_index + 1) % GpuMapDetail::kBuffersCount;
+  imp_->next_buffers_index = imp_->nextBufferIndex(imp_->next_buffers_index);
 }
 
 
@@ -1204,8 +1954,10 @@ int GpuMap::enableVoxelUpload(int cache_id, bool enable)
         return int(i);
       }
       // Request removal and found present. Remove.
-      imp_->voxel_upload_info[0].erase(imp_->voxel_upload_info[0].begin() + i);
-      imp_->voxel_upload_info[1].erase(imp_->voxel_upload_info[1].begin() + i);
+      for (auto &voxel_upload_info : imp_->voxel_upload_info)
+      {
+        voxel_upload_info.erase(voxel_upload_info.begin() + i);
+      }
       return -1;
     }
   }
@@ -1214,8 +1966,10 @@ int GpuMap::enableVoxelUpload(int cache_id, bool enable)
   if (enable)
   {
     // Not found and requesting present. Add.
-    imp_->voxel_upload_info[0].emplace_back(VoxelUploadInfo(cache_id, gpu_cache.gpu()));
-    imp_->voxel_upload_info[1].emplace_back(VoxelUploadInfo(cache_id, gpu_cache.gpu()));
+    for (auto &voxel_upload_info : imp_->voxel_upload_info)
+    {
+      voxel_upload_info.emplace_back(VoxelUploadInfo(cache_id, gpu_cache.gpu()));
+    }
     return int(imp_->voxel_upload_info[0].size() - 1);
   }
 
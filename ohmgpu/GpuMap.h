@@ -12,13 +12,17 @@
 #include <ohm/RayFlag.h>
 #include <ohm/RayMapper.h>
 
+#include <glm/fwd.hpp>
 #include <glm/glm.hpp>
 
 #include <functional>
+#include <limits>
+#include <memory>
 #include <vector>
 
 namespace gputil
 {
+class Device;
 class Event;
 class Buffer;
 class PinnedBuffer;
@@ -29,8 +33,10 @@ namespace ohm
 class Aabb;
 class GpuCache;
 struct GpuMapDetail;
+class GpuMapSnapshot;
 class OccupancyMap;
 class RayFilter;
+class TrajectoryIndex;
 
 struct VoxelUploadInfo;
 
@@ -43,6 +49,26 @@ enum GpuFlag : unsigned
   kGpuAllowMappedBuffers = (1u << 0u),
   /// Force mappable buffers.
   kGpuForceMappedBuffers = (1u << 1u),
+  /// Allocate the cache layers in unified memory on devices sharing host memory, making uploads and downloads host
+  /// side copies. See @c kGcfUnified .
+  kGpuUnifiedMemory = (1u << 2u),
+  /// Use a dedicated queue for layer cache uploads and downloads, so region transfers overlap kernel execution. See
+  /// @c GpuCache::transferQueue() .
+  kGpuTransferQueue = (1u << 3u),
+  /// Create the GPU queues with profiling enabled and collect device timing for kernels and transfers in
+  /// @c GpuCache::profiler() . This adds some overhead, so is intended for tuning.
+  kGpuProfile = (1u << 4u),
+  /// Maintain a device region table for each layer cache, mapping region keys to cache slots. See
+  /// @c kGcfRegionTable .
+  kGpuRegionTable = (1u << 5u),
+  /// Store the occupancy layer in the GPU cache as 16-bit fixed point values, fitting twice the regions in the same
+  /// cache memory. Occupancy values are quantised to ~0.001 log-odds. Ignored for NDT maps. See
+  /// @c kGcfPackedOccupancy .
+  kGpuPackedOccupancy = (1u << 6u),
+  /// Keep map regions resident in the GPU cache without allocating host regions. The host regions are created as
+  /// lazily populated shadows on @c GpuMap::syncVoxels() or when evicted from the cache. Best suited to maps which fit
+  /// in the GPU cache. See @c kGcfResident .
+  kGpuResident = (1u << 7u),
 };
 
 /// Enable GPU usage for the given @p map. This creates a GPU cache for the @p map using the
@@ -71,6 +97,20 @@ GpuCache ohmgpu_API *enableGpu(OccupancyMap &map);
 GpuCache ohmgpu_API *enableGpu(OccupancyMap &map, size_t target_gpu_mem_size,
                                unsigned gpu_flags = kGpuAllowMappedBuffers);
 
+/// Enable GPU usage for the given @p map on a specific @p gpu rather than @c gpuDevice() .
+///
+/// Ignored if the @p map already is GPU enabled, in which case the existing cache may be bound to a different device.
+///
+/// @exception gputil::Exception Thrown when a @c gputil::ApiException is raised during GPU memory allocation.
+///
+/// @param map The map to enable GPU usage on.
+/// @param gpu The device to create the GPU cache on.
+/// @param target_gpu_mem_size Target GPU memory usage. This is split amongst the active, default layers.
+/// @param gpu_flags @c GpuFlag values controlling initialisation.
+/// @return The @c GpuCache for the map. Null if GPU code is not enabled.
+GpuCache ohmgpu_API *enableGpu(OccupancyMap &map, const gputil::Device &gpu, size_t target_gpu_mem_size,
+                               unsigned gpu_flags = kGpuAllowMappedBuffers);
+
 // /// Reports the status of setting up the associated GPU program for populating the map.
 // ///
 // /// integrateRays() only functions when this function reports @c true. Otherwise calls to @c integrateRays() are
@@ -142,6 +182,10 @@ void ohmgpu_API walkRegions(const OccupancyMap &map, const glm::dvec3 &start_poi
 /// occupancy based GPU algorithms.
 class ohmgpu_API GpuMap : public RayMapper
 {
+public:
+  /// Function used to restrict which regions are updated. See @c setRegionFilter() .
+  using RegionFilterFunction = std::function<bool(const glm::i16vec3 &region_key)>;
+
 protected:
   /// Constructor for derived classes to call.
   /// @param detail The pimpl data struture for the map. Must not be null. May be a derivation of @c GpuMapDetail .
@@ -203,6 +247,20 @@ public:
   /// are not present.
   void syncVoxels(const std::vector<int> &layer_indices);
 
+  /// Start an asynchronous sync of the GPU cached layers into a host snapshot, without blocking and without modifying
+  /// the @c map() . Integration may continue while the snapshot downloads; later updates do not affect the snapshot.
+  ///
+  /// The returned snapshot holds the GPU resident regions only. Other regions are up to date in the @c map() . Use
+  /// @c GpuMapSnapshot::isReady() to poll for completion or @c GpuMapSnapshot::wait() to block.
+  ///
+  /// Snapshots are double buffered: the snapshot from the call before last is reused unless the caller still holds
+  /// it, so a reader which releases each snapshot before the next call avoids reallocation. Snapshots must be
+  /// released before the @c gpuCache() is destroyed. Unlike @c syncVoxels() , derived class @c onSyncVoxels() handling
+  /// is not invoked.
+  ///
+  /// @return The snapshot being populated.
+  std::shared_ptr<GpuMapSnapshot> syncVoxelsAsync();
+
   /// Set the range filter applied to all rays given to @c integrateRays(). Setting a null filter ensures no
   /// filtering is performed. The default behaviour is to use the same filter as the @c OccupancyMap.
   ///
@@ -222,9 +280,26 @@ public:
   /// @return The range filter currently in use.
   const RayFilterFunction &effectiveRayFilter() const;
 
-  /// Clears the @c rayFilter(). Unlike the same method in @c OccupancyMap, this is not the same a setting a null
-  /// filter. For the @p GpuMap, @c clearRayFilter() restores the default behaviour of using the same filter
-  /// as the underlying @c OccupancyMap.
+  /// Set the batch ray filter applied to all rays given to @c integrateRays() as a separate pass. When valid, the
+  /// batch filter takes precedence over the @c rayFilter() . See @c OccupancyMap::setRayBatchFilter() .
+  ///
+  /// As with @c setRayFilter() , this overrides the filters of the @c OccupancyMap . @c setRayFilter() clears the
+  /// batch filter.
+  /// @param ray_batch_filter The batch filter to install. Accepts an empty function.
+  void setRayBatchFilter(const RayBatchFilterFunction &ray_batch_filter);
+
+  /// Get the installed batch ray filter.
+  /// @return The installed batch filter.
+  const RayBatchFilterFunction &rayBatchFilter() const;
+
+  /// Get the batch ray filter actually being used. This will be the one belonging to the wrapped @c OccupancyMap
+  /// when the @c GpuMap does not have explicitly installed filters.
+  /// @return The batch filter currently in use.
+  const RayBatchFilterFunction &effectiveRayBatchFilter() const;
+
+  /// Clears the @c rayFilter() and @c rayBatchFilter(). Unlike the same method in @c OccupancyMap, this is not the
+  /// same a setting a null filter. For the @p GpuMap, @c clearRayFilter() restores the default behaviour of using the
+  /// same filters as the underlying @c OccupancyMap.
   void clearRayFilter();
 
   /// Access the @c OccupancyMap::hitValue() for API compatibility.
@@ -261,6 +336,123 @@ public:
   /// @param length The ray length at which to break up rays.
   void setRaySegmentLength(double length);
 
+  /// Query if rays are sorted for memory coherence before upload. See @c setCoherentRays() .
+  /// @return True if sorting rays by region and direction.
+  bool coherentRays() const;
+
+  /// Set whether to sort rays by region and direction before upload to GPU.
+  ///
+  /// Rays are uploaded in input order by default, so neighbouring GPU threads may walk rays in any direction through
+  /// any region, scattering voxel memory access. When enabled, each batch of rays - or ray segments when using
+  /// @c setRaySegmentLength() - is sorted by the region containing the ray origin, then by the direction octant of the
+  /// ray. Threads in the same warp then tend to walk the same voxels in the same order. The sort is a radix sort made
+  /// in CPU while preparing the batch, so the benefit should be measured against the additional CPU cost.
+  ///
+  /// This is ignored when @c groupedRays() is set as the grouping order takes precedence.
+  ///
+  /// @param enable True to sort rays for coherence. Disabled by default.
+  void setCoherentRays(bool enable);
+
+  /// Query if the regions touched by each ray batch are enumerated on GPU. See @c setGpuRegionWalk() .
+  /// @return True if enumerating regions on GPU.
+  bool gpuRegionWalk() const;
+
+  /// Set whether to enumerate the regions touched by each ray batch on GPU.
+  ///
+  /// Each batch requires the set of regions touched by its rays in order to make those regions resident in the GPU
+  /// cache. By default this set is built in CPU by walking the regions of each ray, which for long rays may take as
+  /// long as the GPU update. When enabled, the regions are instead walked on GPU after the rays are uploaded, and only
+  /// the compact list of unique region keys is downloaded. This introduces a synchronisation point after the ray
+  /// upload, so the benefit should be measured for the expected ray lengths.
+  ///
+  /// @param enable True to enumerate regions on GPU. Disabled by default.
+  void setGpuRegionWalk(bool enable);
+
+  /// Get the number of ray batches which may be in flight on the GPU. See @c setPipelineDepth() .
+  /// @return The current pipeline depth.
+  unsigned pipelineDepth() const;
+
+  /// Set the number of ray batches which may be in flight on the GPU.
+  ///
+  /// Each in flight batch uses its own set of ray, key and region buffers. @c integrateRays() prepares the next batch
+  /// in CPU - filtering, segmenting and grouping rays and enumerating the affected regions - before waiting on the
+  /// oldest batch using the same buffer set. A greater depth allows more CPU preparation to overlap GPU execution at
+  /// the cost of GPU memory and cache pressure. The default is 2: double buffering.
+  ///
+  /// This waits for all in flight batches to complete before returning.
+  ///
+  /// @param depth The desired pipeline depth. Clamped to the range `[2, maxPipelineDepth()]` .
+  void setPipelineDepth(unsigned depth);
+
+  /// Query the maximum supported @c pipelineDepth() .
+  /// @return The maximum pipeline depth.
+  static unsigned maxPipelineDepth();
+
+  /// Get the stream batch size. See @c setStreamBatchSize() .
+  /// @return The number of elements (points) accumulated before a streamed batch is submitted. Zero when streaming
+  ///   is disabled.
+  unsigned streamBatchSize() const;
+
+  /// Set the stream batch size, enabling or disabling stream batching of @c integrateRays() calls.
+  ///
+  /// Each GPU batch incurs a fixed CPU and kernel launch overhead which dominates when @c integrateRays() is called
+  /// at a high rate with few rays, such as when integrating individual lidar packets. With a non zero stream batch
+  /// size, @c integrateRays() copies the given rays into a pending stream batch and returns immediately. The pending
+  /// batch is only filtered, uploaded and processed once it holds at least @p element_count elements.
+  ///
+  /// The pending batch is also submitted by @c flushStream() , @c syncVoxels() and when changing the ray filter or
+  /// pipeline depth. It is submitted early when an @c integrateRays() call does not match the pending batch - that is,
+  /// it uses different @c RayFlag values, or differs in the presence of intensities or timestamps. Rays pending when
+  /// the @c GpuMap is destroyed are discarded; call @c flushStream() or @c syncVoxels() first.
+  ///
+  /// Changing the batch size submits any pending rays.
+  ///
+  /// @param element_count The number of elements to accumulate before submitting a batch. This should generally be
+  ///   no larger than the @c expected_element_count given on construction to avoid GPU buffer reallocation. Zero
+  ///   disables stream batching (default).
+  void setStreamBatchSize(unsigned element_count);
+
+  /// Query the number of elements (points) in the pending stream batch. See @c setStreamBatchSize() .
+  /// @return The number of elements pending submission.
+  size_t pendingStreamCount() const;
+
+  /// Submit the pending stream batch to the GPU. Does nothing when there are no pending rays.
+  ///
+  /// See @c setStreamBatchSize() .
+  /// @return The number of elements integrated as per the @c integrateRays() return value.
+  size_t flushStream();
+
+  /// Query if same voxel updates are aggregated on GPU. See @c setAggregateUpdates() .
+  /// @return True if aggregating voxel updates.
+  bool aggregateUpdates() const;
+
+  /// Set whether to aggregate updates to the same voxel within each GPU work group.
+  ///
+  /// Many rays pass through the same voxels near the sensor, each update contending on the same voxel memory. When
+  /// enabled, the GPU sums the free space updates each work group makes to a voxel in local memory and writes each
+  /// voxel once. Sample voxels are then updated as normal. This reduces contention for dense, near field data, but adds
+  /// overhead when rays seldom share voxels, so the benefit depends on the sensor and should be measured.
+  ///
+  /// Results may differ slightly from the default update as the exclusion @c RayFlag values are evaluated once per
+  /// aggregated voxel update, and the summed update is clamped once. Batches using @c kRfStopOnFirstOccupied always use
+  /// the default update. Derivations with their own update kernels, such as @c GpuNdtMap , ignore this setting.
+  ///
+  /// @param enable True to aggregate voxel updates. Disabled by default.
+  void setAggregateUpdates(bool enable);
+
+  /// Get the filter restricting which regions are updated. See @c setRegionFilter() .
+  /// @return The region filter. Empty when all regions are updated.
+  const RegionFilterFunction &regionFilter() const;
+
+  /// Set a filter restricting which regions are updated by @c integrateRays() .
+  ///
+  /// Rays are still walked in full on GPU, but voxels are only updated in regions for which @p filter returns
+  /// @c true . Regions failing the filter are neither uploaded to GPU nor created in the @c map() . This supports
+  /// sharding a map across multiple devices as done by @c GpuMultiMap .
+  ///
+  /// @param filter The region filter. An empty function updates all regions (default).
+  void setRegionFilter(const RegionFilterFunction &filter);
+
   /// Query if rays are being grouped by sample before upload to GPU.
   ///
   /// This is only set for algorithms which require grouping of rays such as the NDT update used by @c GpuNdtMap .
@@ -282,6 +474,9 @@ public:
   ///
   /// Note: This call is ignored if @c gpuOk() is @c false.
   ///
+  /// When stream batching is enabled, the rays may only be accumulated without any GPU update until the stream batch
+  /// is full. See @c setStreamBatchSize() .
+  ///
   /// @param rays Array of origin/sample point pairs.
   /// @param element_count The number of points in @p rays. The ray count is half this value.
   /// @param intensities An array of intensity values matching the @p rays items. There is one intensity value per ray
@@ -297,6 +492,51 @@ public:
 
   using RayMapper::integrateRays;
 
+  /// Integrate sensor frame samples, transforming them into the map frame on GPU.
+  ///
+  /// This is a fused alternative to transforming samples using @c GpuTransformSamples then calling
+  /// @c integrateRays() . The sensor frame samples and sensor trajectory are uploaded once. Each sample is transformed
+  /// using the interpolated sensor pose at the sample time - deskewing the samples - then filtered and converted into
+  /// ray keys on GPU, writing directly into the ray buffers used by the region update. Only the keys of the touched
+  /// regions are downloaded to manage the GPU cache. The transformed rays never return to the host.
+  ///
+  /// The @c effectiveRayFilter() and @c effectiveRayBatchFilter() are not applied. Instead, samples which are
+  /// infinite, NaN or further than @p max_range from the sensor are rejected on GPU - the equivalent of
+  /// @c goodRayFilter() . The @c raySegmentLength() , @c coherentRays() and stream batching settings are also not
+  /// supported and any pending stream batch is flushed first. Intensities are not supported.
+  ///
+  /// The @p sample_times are used to update the touch time layer when present.
+  ///
+  /// @param transform_times Array of timestamps for the sensor to map transforms.
+  /// @param transform_translations Array of translation components of the sensor to map transforms.
+  /// @param transform_rotations Array of quaternion rotations of the sensor to map transforms.
+  /// @param transform_count Number of entries in @p transform_times , @p transform_translations and
+  ///   @p transform_rotations .
+  /// @param sample_times Array of timestamps for @p local_samples .
+  /// @param local_samples The sample points in the sensor frame.
+  /// @param sample_count Number of items in @p local_samples and @p sample_times .
+  /// @param region_update_flags Flags controlling ray integration behaviour. See @c RayFlag.
+  /// @param max_range Maximum sample range from the sensor. Longer rays are rejected.
+  /// @return The number of valid samples integrated.
+  size_t integrateLocalRays(const double *transform_times, const glm::dvec3 *transform_translations,
+                            const glm::dquat *transform_rotations, size_t transform_count, const double *sample_times,
+                            const glm::dvec3 *local_samples, size_t sample_count,
+                            unsigned region_update_flags = kRfDefault,
+                            double max_range = std::numeric_limits<double>::infinity());
+
+  /// @overload
+  /// @param trajectory The trajectory which provides the sensor to map transforms.
+  /// @param sample_times Array of timestamps for @p local_samples .
+  /// @param local_samples The sample points in the sensor frame.
+  /// @param sample_count Number of items in @p local_samples and @p sample_times .
+  /// @param region_update_flags Flags controlling ray integration behaviour. See @c RayFlag.
+  /// @param max_range Maximum sample range from the sensor. Longer rays are rejected.
+  /// @return The number of valid samples integrated.
+  size_t integrateLocalRays(const TrajectoryIndex &trajectory, const double *sample_times,
+                            const glm::dvec3 *local_samples, size_t sample_count,
+                            unsigned region_update_flags = kRfDefault,
+                            double max_range = std::numeric_limits<double>::infinity());
+
   /// Internal use: get the GPU cache used by this map.
   /// @return The GPU cache this map uses.
   GpuCache *gpuCache() const;
@@ -339,10 +579,13 @@ protected:
   /// @param timestamps Optiona - the timestamp value for each ray (element_count/2 elements).
   /// @param region_update_flags Flags controlling ray integration behaviour. See @c RayFlag.
   /// @param filter Filter function apply to each ray before passing to GPU. May be empty.
+  /// @param batch_filter Batch filter applied to the rays in a separate pass, in preference to @p filter . May be
+  ///   empty.
   /// @return The number of rays integrated. Zero indicates a failure when @p pointCount is not zero.
   ///   In this case either the GPU is unavailable, or all @p rays are invalid.
   size_t integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities, const double *timestamps,
-                       unsigned region_update_flags, const RayFilterFunction &filter);
+                       unsigned region_update_flags, const RayFilterFunction &filter,
+                       const RayBatchFilterFunction &batch_filter);
 
   /// Wait for previous ray batch, as indicated by @p buffer_index, to complete.
   /// @param buffer_index Identifies the batch to wait on.
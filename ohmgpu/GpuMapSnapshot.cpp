@@ -0,0 +1,151 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "GpuMapSnapshot.h"
+
+#include "private/GpuMapSnapshotDetail.h"
+
+#include <cmath>
+
+#include "gpu/PackedOccupancy.h"
+
+namespace ohm
+{
+namespace
+{
+const GpuLayerSnapshot *findLayer(const GpuMapSnapshotDetail &imp, int layer_index)
+{
+  for (const auto &layer : imp.layers)
+  {
+    if (layer.active && layer.layer_index == layer_index)
+    {
+      return &layer;
+    }
+  }
+  return nullptr;
+}
+}  // namespace
+
+
+GpuMapSnapshot::GpuMapSnapshot()
+  : imp_(std::make_unique<GpuMapSnapshotDetail>())
+{}
+
+
+GpuMapSnapshot::~GpuMapSnapshot()
+{
+  imp_->reset();
+}
+
+
+uint64_t GpuMapSnapshot::stamp() const
+{
+  return imp_->stamp;
+}
+
+
+bool GpuMapSnapshot::isReady() const
+{
+  if (imp_->complete)
+  {
+    return true;
+  }
+
+  for (const auto &event : imp_->events)
+  {
+    if (!event.isComplete())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void GpuMapSnapshot::wait()
+{
+  if (imp_->complete)
+  {
+    return;
+  }
+
+  for (auto &event : imp_->events)
+  {
+    event.wait();
+  }
+  imp_->events.clear();
+
+  // Unpack packed occupancy layers.
+  for (auto &layer : imp_->layers)
+  {
+    if (!layer.active || !layer.packed)
+    {
+      continue;
+    }
+
+    const size_t region_count = layer.region_indices.size();
+    layer.host_memory.resize(region_count * layer.host_region_size);
+    for (size_t r = 0; r < region_count; ++r)
+    {
+      const auto *src = reinterpret_cast<const uint16_t *>(layer.gpu_memory.data() + r * layer.gpu_region_size);
+      auto *dst = reinterpret_cast<float *>(layer.host_memory.data() + r * layer.host_region_size);
+      for (size_t i = 0; i < layer.region_voxel_count; ++i)
+      {
+        dst[i] = unpackOccupancy(int(int16_t(src[i])));
+      }
+    }
+  }
+
+  imp_->complete = true;
+}
+
+
+bool GpuMapSnapshot::hasLayer(int layer_index) const
+{
+  return findLayer(*imp_, layer_index) != nullptr;
+}
+
+
+size_t GpuMapSnapshot::regionByteSize(int layer_index) const
+{
+  const GpuLayerSnapshot *layer = findLayer(*imp_, layer_index);
+  return (layer) ? layer->host_region_size : 0u;
+}
+
+
+void GpuMapSnapshot::regionKeys(int layer_index, std::vector<glm::i16vec3> &region_keys) const
+{
+  region_keys.clear();
+  const GpuLayerSnapshot *layer = findLayer(*imp_, layer_index);
+  if (layer)
+  {
+    region_keys.reserve(layer->region_indices.size());
+    for (const auto &region : layer->region_indices)
+    {
+      region_keys.emplace_back(region.first);
+    }
+  }
+}
+
+
+const uint8_t *GpuMapSnapshot::voxels(int layer_index, const glm::i16vec3 &region_key)
+{
+  const GpuLayerSnapshot *layer = findLayer(*imp_, layer_index);
+  if (!layer)
+  {
+    return nullptr;
+  }
+
+  const auto region_iter = layer->region_indices.find(region_key);
+  if (region_iter == layer->region_indices.end())
+  {
+    return nullptr;
+  }
+
+  wait();
+  return (layer->packed) ? layer->host_memory.data() + region_iter->second * layer->host_region_size :
+                           layer->gpu_memory.data() + region_iter->second * layer->gpu_region_size;
+}
+}  // namespace ohm
@@ -0,0 +1,84 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPUMAPSNAPSHOT_H
+#define OHMGPU_GPUMAPSNAPSHOT_H
+
+#include "OhmGpuConfig.h"
+
+#include <glm/fwd.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ohm
+{
+struct GpuMapSnapshotDetail;
+
+/// A host copy of the GPU resident voxels of a @c GpuMap , as queued by @c GpuMap::syncVoxelsAsync() .
+///
+/// The snapshot holds a copy of each region held in the GPU cache for each synchronised layer at the time
+/// @c GpuMap::syncVoxelsAsync() was called. The copies are downloaded asynchronously, so @c isReady() reports
+/// whether they have completed and @c wait() blocks until they do. The snapshot content is not affected by later
+/// @c GpuMap updates, so a reader may use it on another thread while the @c GpuMap continues integrating rays. Regions
+/// which are not in the snapshot are not in the GPU cache and are up to date in the @c OccupancyMap .
+///
+/// Voxel data are laid out as in the @c OccupancyMap region for the layer - see @c MapLayer::layerByteSize() .
+class ohmgpu_API GpuMapSnapshot
+{
+public:
+  /// Create an empty snapshot.
+  GpuMapSnapshot();
+  /// Destructor. Waits for outstanding downloads.
+  ~GpuMapSnapshot();
+
+  GpuMapSnapshot(const GpuMapSnapshot &) = delete;
+  GpuMapSnapshot &operator=(const GpuMapSnapshot &) = delete;
+
+  /// Query the @c OccupancyMap::stamp() at the time the snapshot was taken.
+  /// @return The map stamp.
+  uint64_t stamp() const;
+
+  /// Have all the snapshot downloads completed? Does not block.
+  /// @return True when the snapshot is ready to read.
+  bool isReady() const;
+
+  /// Block until all the snapshot downloads have completed.
+  void wait();
+
+  /// Does the snapshot include the map layer at @p layer_index ?
+  /// @param layer_index The @c MapLayout layer index.
+  /// @return True if the layer is in the snapshot.
+  bool hasLayer(int layer_index) const;
+
+  /// Query the byte size of the voxel data for each region in the given layer.
+  /// @param layer_index The @c MapLayout layer index.
+  /// @return The region byte size or zero when @c hasLayer() is false.
+  size_t regionByteSize(int layer_index) const;
+
+  /// Collect the keys of the regions in the snapshot for the given layer.
+  /// @param layer_index The @c MapLayout layer index.
+  /// @param[out] region_keys Populated with the region keys. Cleared first.
+  void regionKeys(int layer_index, std::vector<glm::i16vec3> &region_keys) const;
+
+  /// Access the snapshot voxel data for a region, waiting for the snapshot to complete.
+  /// @param layer_index The @c MapLayout layer index.
+  /// @param region_key The key of the region of interest.
+  /// @return The region voxel data - @c regionByteSize() bytes - or null when the region is not in the snapshot.
+  const uint8_t *voxels(int layer_index, const glm::i16vec3 &region_key);
+
+  /// @internal
+  /// Access the snapshot detail. Used by @c GpuMap and @c GpuLayerCache to populate the snapshot.
+  /// @return The snapshot detail.
+  inline GpuMapSnapshotDetail *detail() { return imp_.get(); }
+
+private:
+  std::unique_ptr<GpuMapSnapshotDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_GPUMAPSNAPSHOT_H
@@ -0,0 +1,325 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "GpuMemoryArbiter.h"
+
+#include <gputil/gpuDevice.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace ohm
+{
+namespace
+{
+struct Consumer
+{
+  GpuMemoryConsumerInfo info;
+  GpuMemoryArbiter::EvictionFunction on_evict;
+  GpuMemoryArbiter::Handle handle = 0;
+};
+}  // namespace
+
+struct GpuMemoryArbiterDetail
+{
+  gputil::Device gpu;
+  std::vector<Consumer> consumers;
+  size_t total_budget = 0;
+  GpuMemoryArbiter::Handle next_handle = 1;
+  mutable std::mutex mutex;
+
+  Consumer *find(GpuMemoryArbiter::Handle handle)
+  {
+    for (Consumer &consumer : consumers)
+    {
+      if (consumer.handle == handle)
+      {
+        return &consumer;
+      }
+    }
+    return nullptr;
+  }
+
+  const Consumer *find(GpuMemoryArbiter::Handle handle) const
+  {
+    return const_cast<GpuMemoryArbiterDetail *>(this)->find(handle);  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  }
+};
+
+namespace
+{
+size_t resolveTotalBudget(const gputil::Device &gpu, size_t total_budget)
+{
+  if (total_budget)
+  {
+    return total_budget;
+  }
+  return (gpu.isValid()) ? size_t(gpu.deviceMemory()) : 0u;
+}
+
+
+/// Recalculate the consumer budgets and invoke the eviction functions for any changes. Expects @p lock to be held
+/// on entry and releases it before invoking the eviction functions.
+void rebalance(GpuMemoryArbiterDetail &imp, std::unique_lock<std::mutex> &lock)
+{
+  // Fixed consumers are allotted what they need.
+  size_t fixed = 0;
+  size_t elastic_minimum = 0;
+  size_t elastic_extra = 0;
+  for (Consumer &consumer : imp.consumers)
+  {
+    if (!consumer.info.elastic)
+    {
+      consumer.info.budget = std::max(consumer.info.request, consumer.info.used);
+      fixed += consumer.info.budget;
+    }
+    else
+    {
+      elastic_minimum += consumer.info.minimum;
+      elastic_extra += consumer.info.request - consumer.info.minimum;
+    }
+  }
+
+  // Share what remains between elastic consumers. Each gets at least its minimum, with the remainder distributed in
+  // proportion to the amount each requests beyond that minimum.
+  const size_t committed = fixed + elastic_minimum;
+  const size_t available = (imp.total_budget > committed) ? imp.total_budget - committed : 0u;
+  const double extra_scale = (elastic_extra > available) ? double(available) / double(elastic_extra) : 1.0;
+
+  std::vector<std::pair<GpuMemoryArbiter::EvictionFunction, size_t>> notify;
+  for (Consumer &consumer : imp.consumers)
+  {
+    if (consumer.info.elastic)
+    {
+      const size_t extra = size_t(double(consumer.info.request - consumer.info.minimum) * extra_scale);
+      const size_t budget = consumer.info.minimum + extra;
+      if (budget != consumer.info.budget)
+      {
+        consumer.info.budget = budget;
+        notify.emplace_back(consumer.on_evict, budget);
+      }
+    }
+  }
+
+  lock.unlock();
+  for (const auto &item : notify)
+  {
+    item.first(item.second);
+  }
+}
+}  // namespace
+
+
+GpuMemoryArbiter::GpuMemoryArbiter(const gputil::Device &gpu, size_t total_budget)
+  : imp_(new GpuMemoryArbiterDetail)
+{
+  imp_->gpu = gpu;
+  imp_->total_budget = resolveTotalBudget(gpu, total_budget);
+}
+
+
+GpuMemoryArbiter::~GpuMemoryArbiter()
+{
+  delete imp_;
+}
+
+
+GpuMemoryArbiter &GpuMemoryArbiter::forDevice(const gputil::Device &gpu)
+{
+  static std::mutex s_mutex;
+  static std::vector<std::unique_ptr<GpuMemoryArbiter>> s_arbiters;
+  std::unique_lock<std::mutex> guard(s_mutex);
+  for (auto &arbiter : s_arbiters)
+  {
+    if (arbiter->imp_->gpu == gpu)
+    {
+      return *arbiter;
+    }
+  }
+
+  s_arbiters.emplace_back(std::make_unique<GpuMemoryArbiter>(gpu));
+  return *s_arbiters.back();
+}
+
+
+size_t GpuMemoryArbiter::totalBudget() const
+{
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  return imp_->total_budget;
+}
+
+
+void GpuMemoryArbiter::setTotalBudget(size_t total_budget)
+{
+  std::unique_lock<std::mutex> lock(imp_->mutex);
+  imp_->total_budget = resolveTotalBudget(imp_->gpu, total_budget);
+  rebalance(*imp_, lock);
+}
+
+
+GpuMemoryArbiter::Handle GpuMemoryArbiter::registerConsumer(const std::string &name, size_t request, size_t minimum,
+                                                            const EvictionFunction &on_evict)
+{
+  std::unique_lock<std::mutex> lock(imp_->mutex);
+  Consumer consumer;
+  consumer.info.name = name;
+  consumer.info.request = request;
+  consumer.info.minimum = std::min(minimum, request);
+  consumer.info.elastic = bool(on_evict);
+  // Start elastic consumers at their request so the initial rebalance only notifies them of a reduction.
+  consumer.info.budget = request;
+  consumer.on_evict = on_evict;
+  consumer.handle = imp_->next_handle++;
+  const Handle handle = consumer.handle;
+  imp_->consumers.emplace_back(std::move(consumer));
+  rebalance(*imp_, lock);
+  return handle;
+}
+
+
+void GpuMemoryArbiter::unregisterConsumer(Handle handle)
+{
+  std::unique_lock<std::mutex> lock(imp_->mutex);
+  const auto iter = std::find_if(imp_->consumers.begin(), imp_->consumers.end(),
+                                 [handle](const Consumer &consumer) { return consumer.handle == handle; });
+  if (iter == imp_->consumers.end())
+  {
+    return;
+  }
+  imp_->consumers.erase(iter);
+  rebalance(*imp_, lock);
+}
+
+
+void GpuMemoryArbiter::updateRequest(Handle handle, size_t request, size_t minimum)
+{
+  std::unique_lock<std::mutex> lock(imp_->mutex);
+  Consumer *consumer = imp_->find(handle);
+  if (!consumer)
+  {
+    return;
+  }
+  minimum = std::min(minimum, request);
+  if (consumer->info.request == request && consumer->info.minimum == minimum)
+  {
+    return;
+  }
+  consumer->info.request = request;
+  consumer->info.minimum = minimum;
+  rebalance(*imp_, lock);
+}
+
+
+void GpuMemoryArbiter::reportUsage(Handle handle, size_t used)
+{
+  std::unique_lock<std::mutex> lock(imp_->mutex);
+  Consumer *consumer = imp_->find(handle);
+  if (!consumer || consumer->info.used == used)
+  {
+    return;
+  }
+  consumer->info.used = used;
+  // Usage only affects the budgets when it changes the allotment for a fixed consumer.
+  if (!consumer->info.elastic && std::max(consumer->info.request, used) != consumer->info.budget)
+  {
+    rebalance(*imp_, lock);
+  }
+}
+
+
+size_t GpuMemoryArbiter::budget(Handle handle) const
+{
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  const Consumer *consumer = imp_->find(handle);
+  return (consumer) ? consumer->info.budget : 0u;
+}
+
+
+GpuMemoryUsage GpuMemoryArbiter::usage() const
+{
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  GpuMemoryUsage usage;
+  usage.total_budget = imp_->total_budget;
+  usage.consumers.reserve(imp_->consumers.size());
+  for (const Consumer &consumer : imp_->consumers)
+  {
+    usage.allotted += consumer.info.budget;
+    usage.used += consumer.info.used;
+    usage.consumers.emplace_back(consumer.info);
+  }
+  return usage;
+}
+
+
+GpuMemoryConsumer::GpuMemoryConsumer(GpuMemoryArbiter &arbiter, const std::string &name, size_t request,
+                                     size_t minimum, const GpuMemoryArbiter::EvictionFunction &on_evict)
+  : arbiter_(&arbiter)
+  , handle_(arbiter.registerConsumer(name, request, minimum, on_evict))
+{}
+
+
+GpuMemoryConsumer::GpuMemoryConsumer(GpuMemoryConsumer &&other) noexcept
+  : arbiter_(other.arbiter_)
+  , handle_(other.handle_)
+{
+  other.arbiter_ = nullptr;
+  other.handle_ = 0;
+}
+
+
+GpuMemoryConsumer::~GpuMemoryConsumer()
+{
+  release();
+}
+
+
+GpuMemoryConsumer &GpuMemoryConsumer::operator=(GpuMemoryConsumer &&other) noexcept
+{
+  if (this != &other)
+  {
+    release();
+    std::swap(arbiter_, other.arbiter_);
+    std::swap(handle_, other.handle_);
+  }
+  return *this;
+}
+
+
+void GpuMemoryConsumer::updateRequest(size_t request, size_t minimum)
+{
+  if (arbiter_)
+  {
+    arbiter_->updateRequest(handle_, request, minimum);
+  }
+}
+
+
+void GpuMemoryConsumer::reportUsage(size_t used)
+{
+  if (arbiter_)
+  {
+    arbiter_->reportUsage(handle_, used);
+  }
+}
+
+
+size_t GpuMemoryConsumer::budget() const
+{
+  return (arbiter_) ? arbiter_->budget(handle_) : 0u;
+}
+
+
+void GpuMemoryConsumer::release()
+{
+  if (arbiter_)
+  {
+    arbiter_->unregisterConsumer(handle_);
+    arbiter_ = nullptr;
+    handle_ = 0;
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,188 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPUMEMORYARBITER_H
+#define OHMGPU_GPUMEMORYARBITER_H
+
+#include "OhmGpuConfig.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gputil
+{
+class Device;
+}  // namespace gputil
+
+namespace ohm
+{
+struct GpuMemoryArbiterDetail;
+
+/// Memory details for a single consumer registered with a @c GpuMemoryArbiter .
+struct ohmgpu_API GpuMemoryConsumerInfo
+{
+  std::string name;      ///< Consumer name given on registration.
+  size_t request = 0;    ///< The number of bytes the consumer would like to use.
+  size_t minimum = 0;    ///< The minimum number of bytes the consumer requires.
+  size_t budget = 0;     ///< The number of bytes currently allotted to the consumer.
+  size_t used = 0;       ///< The number of bytes the consumer last reported using.
+  bool elastic = false;  ///< True if the consumer adapts to budget changes.
+};
+
+/// GPU memory usage report from @c GpuMemoryArbiter::usage() .
+struct ohmgpu_API GpuMemoryUsage
+{
+  size_t total_budget = 0;  ///< The @c GpuMemoryArbiter::totalBudget() .
+  size_t allotted = 0;      ///< Sum of all consumer budgets. May exceed @c total_budget when over committed.
+  size_t used = 0;          ///< Sum of all reported consumer usage.
+  /// Details for each registered consumer in registration order.
+  std::vector<GpuMemoryConsumerInfo> consumers;
+};
+
+/// Arbitrates GPU memory between the ohm components allocating on the same @c gputil::Device .
+///
+/// Components such as @c GpuCache , @c ClearanceProcess , @c RaysQueryGpu and @c LineKeysQueryGpu register as
+/// consumers in order to share the @c totalBudget() rather than each allocating independently. There are two kinds of
+/// consumer:
+///
+/// - Fixed consumers allocate what they need and report it via @c reportUsage() . They are always allotted the larger
+///   of their request and their reported usage.
+/// - Elastic consumers register with an @c EvictionFunction and adapt to the budget they are given. The memory
+///   remaining after fixed consumers is shared between elastic consumers. Each elastic consumer receives at least its
+///   minimum, then the remainder is shared in proportion to the amount each consumer requests above its minimum.
+///
+/// The @c EvictionFunction is invoked whenever the budget for an elastic consumer changes, including when the budget
+/// grows as other consumers release memory. Consumers should shrink below the new budget, evicting data as required,
+/// at the next point it is safe to do so. The function may be invoked from any thread using the arbiter and is never
+/// called while the arbiter is locked, so it may query the arbiter.
+///
+/// Consumers are most easily managed using a @c GpuMemoryConsumer .
+class ohmgpu_API GpuMemoryArbiter
+{
+public:
+  /// Handle for a registered consumer. Zero is never a valid handle.
+  using Handle = unsigned;
+  /// Function invoked with the new budget for an elastic consumer (bytes).
+  using EvictionFunction = std::function<void(size_t)>;
+
+  /// Create an arbiter for @p gpu . Generally the shared instance from @c forDevice() should be used instead.
+  /// @param gpu The device to arbitrate memory for.
+  /// @param total_budget The memory to share between consumers (bytes). Zero selects the device memory size.
+  explicit GpuMemoryArbiter(const gputil::Device &gpu, size_t total_budget = 0);
+  /// Destructor.
+  ~GpuMemoryArbiter();
+
+  GpuMemoryArbiter(const GpuMemoryArbiter &) = delete;
+  GpuMemoryArbiter &operator=(const GpuMemoryArbiter &) = delete;
+
+  /// Access the shared arbiter for @p gpu , creating it on first use.
+  /// @param gpu The device of interest.
+  /// @return The arbiter for @p gpu .
+  static GpuMemoryArbiter &forDevice(const gputil::Device &gpu);
+
+  /// Query the memory to share between all consumers (bytes).
+  /// @return The total memory budget.
+  size_t totalBudget() const;
+
+  /// Set the memory to share between all consumers. Elastic consumers are notified of any budget changes.
+  /// @param total_budget The memory to share (bytes). Zero selects the device memory size.
+  void setTotalBudget(size_t total_budget);
+
+  /// Register a memory consumer.
+  /// @param name Descriptive name for the consumer. Used in the @c usage() report.
+  /// @param request The number of bytes the consumer would like to use.
+  /// @param minimum The minimum number of bytes the consumer requires. Limited to @p request .
+  /// @param on_evict Function invoked when the consumer budget changes. The consumer is elastic when this is set.
+  /// @return The consumer handle.
+  Handle registerConsumer(const std::string &name, size_t request, size_t minimum,
+                          const EvictionFunction &on_evict = EvictionFunction());
+
+  /// Unregister the consumer for @p handle , releasing its budget to other consumers.
+  /// @param handle The consumer to unregister. Ignored if not registered.
+  void unregisterConsumer(Handle handle);
+
+  /// Change the memory request for a consumer.
+  /// @param handle The consumer of interest.
+  /// @param request The number of bytes the consumer would like to use.
+  /// @param minimum The minimum number of bytes the consumer requires. Limited to @p request .
+  void updateRequest(Handle handle, size_t request, size_t minimum);
+
+  /// Report the number of bytes currently allocated by a consumer.
+  /// @param handle The consumer of interest.
+  /// @param used The number of bytes allocated.
+  void reportUsage(Handle handle, size_t used);
+
+  /// Query the budget allotted to a consumer.
+  /// @param handle The consumer of interest.
+  /// @return The consumer budget (bytes) or zero if @p handle is not registered.
+  size_t budget(Handle handle) const;
+
+  /// Report memory usage for all consumers.
+  /// @return The current usage.
+  GpuMemoryUsage usage() const;
+
+private:
+  GpuMemoryArbiterDetail *imp_;
+};
+
+/// Registration of a single consumer with a @c GpuMemoryArbiter , which is unregistered on destruction.
+class ohmgpu_API GpuMemoryConsumer
+{
+public:
+  /// Create an unregistered consumer.
+  GpuMemoryConsumer() = default;
+  /// Register a consumer with @p arbiter . See @c GpuMemoryArbiter::registerConsumer() .
+  GpuMemoryConsumer(GpuMemoryArbiter &arbiter, const std::string &name, size_t request, size_t minimum,
+                    const GpuMemoryArbiter::EvictionFunction &on_evict = GpuMemoryArbiter::EvictionFunction());
+  /// Move constructor.
+  /// @param other Object to move.
+  GpuMemoryConsumer(GpuMemoryConsumer &&other) noexcept;
+  GpuMemoryConsumer(const GpuMemoryConsumer &) = delete;
+  /// Destructor, unregistering the consumer.
+  ~GpuMemoryConsumer();
+
+  /// Move assignment.
+  /// @param other Object to move.
+  /// @return @c *this
+  GpuMemoryConsumer &operator=(GpuMemoryConsumer &&other) noexcept;
+  GpuMemoryConsumer &operator=(const GpuMemoryConsumer &) = delete;
+
+  /// Is this consumer registered?
+  /// @return True when registered.
+  bool isValid() const { return arbiter_ != nullptr; }
+
+  /// Access the arbiter this consumer is registered with.
+  /// @return The arbiter or null when not registered.
+  GpuMemoryArbiter *arbiter() const { return arbiter_; }
+
+  /// Query the consumer handle.
+  /// @return The handle, zero when not registered.
+  GpuMemoryArbiter::Handle handle() const { return handle_; }
+
+  /// Change the request. See @c GpuMemoryArbiter::updateRequest() .
+  /// @param request The number of bytes the consumer would like to use.
+  /// @param minimum The minimum number of bytes the consumer requires.
+  void updateRequest(size_t request, size_t minimum);
+
+  /// Report usage. See @c GpuMemoryArbiter::reportUsage() .
+  /// @param used The number of bytes allocated.
+  void reportUsage(size_t used);
+
+  /// Query the budget. See @c GpuMemoryArbiter::budget() .
+  /// @return The consumer budget (bytes) or zero when not registered.
+  size_t budget() const;
+
+  /// Unregister the consumer.
+  void release();
+
+private:
+  GpuMemoryArbiter *arbiter_ = nullptr;
+  GpuMemoryArbiter::Handle handle_ = 0;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_GPUMEMORYARBITER_H
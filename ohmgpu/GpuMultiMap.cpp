@@ -0,0 +1,298 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "GpuMultiMap.h"
+
+#include "GpuMap.h"
+
+#include <ohm/CopyUtil.h>
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+
+#include <ohm/private/OccupancyMapDetail.h>
+
+#include <ohmutil/VectorHash.h>
+
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuDeviceInfo.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+namespace ohm
+{
+struct GpuMultiMapDetail
+{
+  /// The target map. Updated directly by device zero.
+  OccupancyMap *map = nullptr;
+  /// Shard maps for devices `[1, deviceCount())` .
+  std::vector<std::unique_ptr<OccupancyMap>> shard_maps;
+  /// @c GpuMap for each device.
+  std::vector<std::unique_ptr<GpuMap>> gpu_maps;
+  /// Ray batches routed to each device.
+  std::vector<std::vector<glm::dvec3>> device_rays;
+  /// Intensity values routed to each device.
+  std::vector<std::vector<float>> device_intensities;
+  /// Timestamp values routed to each device.
+  std::vector<std::vector<double>> device_timestamps;
+  /// Per device flags marking the devices touched by the current ray.
+  std::vector<uint8_t> touched;
+  /// Input rays after the ray filter pass, used for routing.
+  std::vector<glm::dvec3> filtered_rays;
+  /// @c RayFilterFlag values for each of the @c filtered_rays .
+  std::vector<unsigned> filter_flags;
+};
+
+namespace
+{
+inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((-value - 1) / divisor) - 1;
+}
+}  // namespace
+
+
+GpuMultiMap::GpuMultiMap(OccupancyMap *map, const std::vector<gputil::Device> &devices,
+                         unsigned expected_element_count, size_t gpu_mem_size)
+  : imp_(std::make_unique<GpuMultiMapDetail>())
+{
+  imp_->map = map;
+  if (!map)
+  {
+    return;
+  }
+
+  for (size_t i = 0; i < devices.size(); ++i)
+  {
+    // Use the same index type regionOwner() returns.
+    const auto device_index = unsigned(i);
+    OccupancyMap *device_map = map;
+    if (device_index > 0)
+    {
+      // Build a shard map matching the target map configuration, seeded with the regions this device owns.
+      auto shard = std::make_unique<OccupancyMap>(map->resolution(), map->regionVoxelDimensions());
+      shard->detail()->copyFrom(*map->detail());
+      if (map->rayFilter())
+      {
+        shard->setRayFilter(map->rayFilter());
+      }
+      shard->setRayBatchFilter(map->rayBatchFilter());
+      copyMap(*shard, *map, [this, device_index](const MapChunk &chunk) {
+        return regionOwner(chunk.region.coord) == device_index;
+      });
+      device_map = shard.get();
+      imp_->shard_maps.emplace_back(std::move(shard));
+    }
+
+    // Create the GPU cache on the required device before the GpuMap can create it on the default device.
+    gpumap::enableGpu(*device_map, devices[i], gpu_mem_size);
+    auto gpu_map = std::make_unique<GpuMap>(device_map, true, expected_element_count, gpu_mem_size);
+    gpu_map->setRegionFilter(
+      [this, device_index](const glm::i16vec3 &region_key) { return regionOwner(region_key) == device_index; });
+    imp_->gpu_maps.emplace_back(std::move(gpu_map));
+  }
+
+  imp_->device_rays.resize(devices.size());
+  imp_->device_intensities.resize(devices.size());
+  imp_->device_timestamps.resize(devices.size());
+  imp_->touched.resize(devices.size());
+}
+
+
+GpuMultiMap::~GpuMultiMap()
+{
+  syncVoxels();
+  // Release the GpuMap objects before the shard maps they reference.
+  imp_->gpu_maps.clear();
+  imp_->shard_maps.clear();
+}
+
+
+unsigned GpuMultiMap::enumerateDevices(std::vector<gputil::Device> &devices)
+{
+  std::vector<gputil::DeviceInfo> device_infos;
+  gputil::Device::enumerateDevices(device_infos);
+
+  unsigned added = 0;
+  for (unsigned i = 0; i < unsigned(device_infos.size()); ++i)
+  {
+    if (device_infos[i].type == gputil::kDeviceGpu)
+    {
+      gputil::Device device;
+      if (device.selectIndex(i))
+      {
+        devices.emplace_back(std::move(device));
+        ++added;
+      }
+    }
+  }
+
+  return added;
+}
+
+
+bool GpuMultiMap::valid() const
+{
+  if (imp_->gpu_maps.empty())
+  {
+    return false;
+  }
+
+  for (const auto &gpu_map : imp_->gpu_maps)
+  {
+    if (!gpu_map->gpuOk())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+OccupancyMap &GpuMultiMap::map()
+{
+  return *imp_->map;
+}
+
+
+const OccupancyMap &GpuMultiMap::map() const
+{
+  return *imp_->map;
+}
+
+
+unsigned GpuMultiMap::deviceCount() const
+{
+  return unsigned(imp_->gpu_maps.size());
+}
+
+
+GpuMap &GpuMultiMap::deviceMap(unsigned device_index)
+{
+  return *imp_->gpu_maps[device_index];
+}
+
+
+const GpuMap &GpuMultiMap::deviceMap(unsigned device_index) const
+{
+  return *imp_->gpu_maps[device_index];
+}
+
+
+unsigned GpuMultiMap::regionOwner(const glm::i16vec3 &region_key) const
+{
+  const unsigned device_count = deviceCount();
+  if (device_count <= 1)
+  {
+    return 0;
+  }
+
+  const uint32_t hash =
+    vhash::hash(floorDiv(region_key.x, kRegionBlockSize), floorDiv(region_key.y, kRegionBlockSize),
+                floorDiv(region_key.z, kRegionBlockSize));
+  return hash % device_count;
+}
+
+
+void GpuMultiMap::syncVoxels()
+{
+  for (const auto &gpu_map : imp_->gpu_maps)
+  {
+    gpu_map->syncVoxels();
+  }
+
+  // Gather the shard regions. The shards only contain regions owned by their device.
+  for (const auto &shard : imp_->shard_maps)
+  {
+    copyMap(*imp_->map, *shard);
+  }
+}
+
+
+size_t GpuMultiMap::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
+                                  const double *timestamps, unsigned ray_update_flags)
+{
+  if (!valid())
+  {
+    return 0u;
+  }
+
+  if (deviceCount() == 1)
+  {
+    return imp_->gpu_maps.front()->integrateRays(rays, element_count, intensities, timestamps, ray_update_flags);
+  }
+
+  if (timestamps && element_count >= 2)
+  {
+    // Touch times are encoded relative to the first ray time. Ensure all shards share the target map value.
+    const double first_ray_time = imp_->map->updateFirstRayTime(*timestamps);
+    for (const auto &shard : imp_->shard_maps)
+    {
+      shard->setFirstRayTime(first_ray_time);
+    }
+  }
+
+  for (size_t d = 0; d < imp_->gpu_maps.size(); ++d)
+  {
+    imp_->device_rays[d].clear();
+    imp_->device_intensities[d].clear();
+    imp_->device_timestamps[d].clear();
+  }
+
+  // Route the rays. We walk the filtered ray, but submit the original ray as each GpuMap applies the filter again.
+  const GpuMap &filter_map = *imp_->gpu_maps.front();
+  imp_->filtered_rays.assign(rays, rays + (element_count & ~size_t(1u)));
+  imp_->filter_flags.resize(element_count / 2);
+  filterRays(imp_->filtered_rays.data(), imp_->filter_flags.data(), element_count / 2,
+             filter_map.effectiveRayBatchFilter(), filter_map.effectiveRayFilter());
+
+  const auto mark_owner = [this](const glm::i16vec3 &region_key, const glm::dvec3 & /*origin*/,
+                                 const glm::dvec3 & /*sample*/) { imp_->touched[regionOwner(region_key)] = 1u; };
+  size_t routed_count = 0;
+  for (size_t i = 0; i + 1 < element_count; i += 2)
+  {
+    if (imp_->filter_flags[i >> 1u] & kRffInvalid)
+    {
+      continue;
+    }
+
+    std::fill(imp_->touched.begin(), imp_->touched.end(), uint8_t(0u));
+    gpumap::walkRegions(*imp_->map, imp_->filtered_rays[i + 0], imp_->filtered_rays[i + 1], mark_owner);
+
+    for (size_t d = 0; d < imp_->touched.size(); ++d)
+    {
+      if (imp_->touched[d])
+      {
+        imp_->device_rays[d].emplace_back(rays[i + 0]);
+        imp_->device_rays[d].emplace_back(rays[i + 1]);
+        if (intensities)
+        {
+          imp_->device_intensities[d].emplace_back(intensities[i >> 1u]);
+        }
+        if (timestamps)
+        {
+          imp_->device_timestamps[d].emplace_back(timestamps[i >> 1u]);
+        }
+      }
+    }
+    routed_count += 2;
+  }
+
+  // Submit each device batch. Each GpuMap queues its GPU work asynchronously, so the devices execute concurrently.
+  for (size_t d = 0; d < imp_->gpu_maps.size(); ++d)
+  {
+    if (!imp_->device_rays[d].empty())
+    {
+      imp_->gpu_maps[d]->integrateRays(imp_->device_rays[d].data(), imp_->device_rays[d].size(),
+                                       (intensities) ? imp_->device_intensities[d].data() : nullptr,
+                                       (timestamps) ? imp_->device_timestamps[d].data() : nullptr, ray_update_flags);
+    }
+  }
+
+  return routed_count;
+}
+}  // namespace ohm
@@ -0,0 +1,124 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPUMULTIMAP_H
+#define OHMGPU_GPUMULTIMAP_H
+
+#include "OhmGpuConfig.h"
+
+#include <ohm/RayMapper.h>
+
+#include <glm/fwd.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace gputil
+{
+class Device;
+}  // namespace gputil
+
+namespace ohm
+{
+class GpuMap;
+class OccupancyMap;
+struct GpuMultiMapDetail;
+
+/// A @c RayMapper which shards GPU occupancy updates for an @c OccupancyMap across multiple GPU devices.
+///
+/// Each device owns a subset of the map regions and has its own @c GpuMap and @c GpuCache . Region ownership is
+/// assigned by hashing region keys in blocks of @c kRegionBlockSize regions along each axis - see @c regionOwner() .
+/// Blocks preserve some spatial locality so that most rays are only submitted to one or two devices.
+///
+/// The first device operates directly on the target @c map() . Each additional device operates on a shard map with
+/// the same configuration as the target map, seeded with the target map regions it owns. @c syncVoxels() gathers the
+/// shard regions back into the target map.
+///
+/// @c integrateRays() filters the rays using the @c OccupancyMap::rayBatchFilter() or @c OccupancyMap::rayFilter()
+/// then submits each ray to every device which owns at least one region touched by the ray. Each device only updates
+/// the regions it owns, using @c GpuMap::setRegionFilter() .
+///
+/// Limitations:
+/// - Only occupancy updates, as per @c GpuMap , are supported. Derivations such as @c GpuNdtMap are not sharded.
+/// - The shard maps hold a host memory copy of the regions owned by the additional devices.
+/// - The target map must not be modified other than via this object, and should only be read after
+///   @c syncVoxels() .
+class ohmgpu_API GpuMultiMap : public RayMapper
+{
+public:
+  /// Number of regions along each axis in each block of regions assigned to a single device.
+  static const int kRegionBlockSize = 4;
+
+  /// Create a multi device mapper for @p map . The @p map pointer is borrowed and must outlive this object.
+  ///
+  /// @exception gputil::Exception Thrown when a @c gputil::ApiException is raised during GPU memory allocation.
+  ///
+  /// @param map The map to update.
+  /// @param devices The devices to shard the map across. Must not be empty. A device may be repeated, which is mainly
+  ///   useful for testing. The first device is ignored if @p map already has a @c GpuCache in which case that cache
+  ///   is used.
+  /// @param expected_element_count The expected point count for calls to @c integrateRays(). Used as a hint.
+  /// @param gpu_mem_size Optionally specify the target GPU cache memory to allocate on each device.
+  GpuMultiMap(OccupancyMap *map, const std::vector<gputil::Device> &devices,
+              unsigned expected_element_count = 2048,  // NOLINT(readability-magic-numbers)
+              size_t gpu_mem_size = 0u);
+
+  /// Destructor. Gathers all device updates into the @c map() .
+  ~GpuMultiMap() override;
+
+  /// Select all available GPU devices suitable for a @c GpuMultiMap .
+  /// @param[out] devices Populated with the GPU devices.
+  /// @return The number of devices added to @p devices .
+  static unsigned enumerateDevices(std::vector<gputil::Device> &devices);
+
+  /// Validate function from @c RayMapper . True when there is at least one device and all @c GpuMap::gpuOk() .
+  /// @return True if validated and @c integrateRays() is safe to call.
+  bool valid() const override;
+
+  /// Access the target map.
+  /// @return The map being updated.
+  OccupancyMap &map();
+  /// @overload
+  const OccupancyMap &map() const;
+
+  /// Query the number of devices the map is sharded across.
+  /// @return The device count.
+  unsigned deviceCount() const;
+
+  /// Access the @c GpuMap for the device at @p device_index .
+  /// @param device_index The device index `[0, deviceCount())` .
+  /// @return The @c GpuMap for the device.
+  GpuMap &deviceMap(unsigned device_index);
+  /// @overload
+  const GpuMap &deviceMap(unsigned device_index) const;
+
+  /// Query the index of the device which owns the region at @p region_key .
+  /// @param region_key The region of interest.
+  /// @return The owning device index `[0, deviceCount())` .
+  unsigned regionOwner(const glm::i16vec3 &region_key) const;
+
+  /// Sync all devices back to main memory and gather the regions from the shard maps into the @c map() .
+  void syncVoxels();
+
+  /// Integrate the given @p rays into the map, routing each ray to the devices which own the regions it touches.
+  /// See @c GpuMap::integrateRays() .
+  ///
+  /// @param rays Array of origin/sample point pairs.
+  /// @param element_count The number of points in @p rays. The ray count is half this value.
+  /// @param intensities Optional intensity values, one per ray.
+  /// @param timestamps Optional timestamp values, one per ray.
+  /// @param ray_update_flags Flags controlling ray integration behaviour. See @c RayFlag.
+  /// @return The number of elements in @p rays which passed the ray filter and were submitted to a device.
+  size_t integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
+                       const double *timestamps, unsigned ray_update_flags) override;
+
+  using RayMapper::integrateRays;
+
+private:
+  std::unique_ptr<GpuMultiMapDetail> imp_;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_GPUMULTIMAP_H
@@ -77,7 +77,7 @@ GpuNdtMap::GpuNdtMap(OccupancyMap *map, bool borrowed_map, unsigned expected_ele
 {
   // Ensure voxel mean and covariance layers are present.
 
-  for (int i = 0; i < 2; ++i)
+  for (unsigned i = 0; i < GpuMapDetail::kMaxBuffersCount; ++i)
   {
     if (ndt_mode != NdtMode::kNone)
     {
@@ -173,13 +173,15 @@ void GpuNdtMap::cacheGpuProgram(bool /*with_voxel_mean*/, bool /*with_traversal_
   case NdtMode::kTraversability:
     imp->program_ref = &g_program_ref_ndt_miss;
     imp->cov_hit_program_ref = &g_program_ref_ndt_hit;
-    imp->gpu_ok = imp->program_ref->addReference(gpu_cache.gpu()) && imp_->gpu_ok;
-    imp->gpu_ok = imp->cov_hit_program_ref->addReference(gpu_cache.gpu()) && imp_->gpu_ok;
+    imp->program_gpu = gpu_cache.gpu();
+    imp->gpu_ok = imp->program_ref->addReference(imp->program_gpu) && imp_->gpu_ok;
+    imp->gpu_ok = imp->cov_hit_program_ref->addReference(imp->program_gpu) && imp_->gpu_ok;
 
     if (imp_->gpu_ok)
     {
-      imp->update_kernel = GPUTIL_MAKE_KERNEL(imp->program_ref->program(), regionRayUpdateNdt);
-      imp->cov_hit_kernel = GPUTIL_MAKE_KERNEL(imp->cov_hit_program_ref->program(), covarianceHitNdt);
+      imp->update_kernel = GPUTIL_MAKE_KERNEL(imp->program_ref->program(imp->program_gpu), regionRayUpdateNdt);
+      imp->cov_hit_kernel =
+        GPUTIL_MAKE_KERNEL(imp->cov_hit_program_ref->program(imp->program_gpu), covarianceHitNdt);
     }
     break;
   }
@@ -265,7 +267,7 @@ void GpuNdtMap::finaliseBatch(unsigned region_update_flags)
     }
   }
 
-  imp->next_buffers_index = 1 - imp->next_buffers_index;
+  imp->next_buffers_index = imp->nextBufferIndex(imp->next_buffers_index);
 }
 
 
@@ -280,7 +282,7 @@ void GpuNdtMap::releaseGpuProgram()
 
   if (imp && imp->cov_hit_program_ref)
   {
-    imp->cov_hit_program_ref->releaseReference();
+    imp->cov_hit_program_ref->releaseReference(imp->program_gpu);
     imp->cov_hit_program_ref = nullptr;
   }
 }
@@ -366,6 +368,7 @@ void GpuNdtMap::invokeNdt(unsigned region_update_flags, int buf_idx, gputil::Eve
   // Enqueue update kernel.
   const gputil::int3 region_dim_gpu = { map->region_voxel_dimensions.x, map->region_voxel_dimensions.y,
                                         map->region_voxel_dimensions.z };
+  const unsigned voxel_order_gpu = unsigned(imp->map->voxelOrder());
 
   const unsigned region_count = imp->region_counts[buf_idx];
   const unsigned ray_count = imp->ray_counts[buf_idx];
@@ -414,8 +417,8 @@ void GpuNdtMap::invokeNdt(unsigned region_update_flags, int buf_idx, gputil::Eve
       gputil::BufferArg<gputil::float3>(imp->ray_buffers[buf_idx]), ray_count,
       // Input touch times buffer
       gputil::BufferArg<uint32_t>(nullptr),  // No touch times for miss update
-      // Region dimensions, map resolution, ray adjustment (miss), sample adjustment (hit)
-      region_dim_gpu, float(map->resolution), map->miss_value, map->hit_value,
+      // Region dimensions, voxel order, map resolution, ray adjustment (miss), sample adjustment (hit)
+      region_dim_gpu, voxel_order_gpu, float(map->resolution), map->miss_value, map->hit_value,
       // Occupied threshold, min occupancy, max occupancy.
       map->occupancy_threshold_value, map->min_voxel_value, map->max_voxel_value,
       // Update flags, NDT adaptation rate, NDT model sensor noise
@@ -428,7 +431,7 @@ void GpuNdtMap::invokeNdt(unsigned region_update_flags, int buf_idx, gputil::Eve
   {
     // NDT can only have one CovarianceHitNdtTm batch in flight because it does not support contension. Ensure previous
     // one has completed and it waits on the kernel above to finish too.
-    waitOnPreviousOperation(1 - buf_idx);
+    waitOnPreviousOperation(imp->previousBufferIndex(buf_idx));
 
     global_size = gputil::Dim3(sample_count);
     local_size = gputil::Dim3(std::min<size_t>(imp->cov_hit_kernel.optimalWorkGroupSize(), sample_count));
@@ -475,8 +478,10 @@ void GpuNdtMap::invokeNdt(unsigned region_update_flags, int buf_idx, gputil::Eve
                                                                                   nullptr),
       // Input intensities buffer
       gputil::BufferArg<float>(intensity_layer_cache ? &imp->intensities_buffers[buf_idx] : nullptr),
-      // Region dimensions, map resolution, sample adjustment (hit), occupancy threshold, occupancy max value
-      region_dim_gpu, float(map->resolution), map->hit_value, map->occupancy_threshold_value, map->max_voxel_value,
+      // Region dimensions, voxel order, map resolution, sample adjustment (hit), occupancy threshold, occupancy max
+      // value
+      region_dim_gpu, voxel_order_gpu, float(map->resolution), map->hit_value, map->occupancy_threshold_value,
+      map->max_voxel_value,
       // Intensity covariance initialisation, NDT sample threshold, NDT adaptation rate
       imp->ndt_map.initialIntensityCovariance(), imp->ndt_map.ndtSampleThreshold(), imp->ndt_map.adaptationRate(),
       // NDT model sensor noise, NDt reinitialisation covariance threshold
@@ -0,0 +1,275 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "GpuOccupancyTsdfMap.h"
+
+#include "private/GpuOccupancyTsdfMapDetail.h"
+
+#include "GpuCache.h"
+#include "GpuKey.h"
+#include "GpuLayerCache.h"
+
+#include "private/GpuProgramRef.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayFlag.h>
+#include <ohm/VoxelMean.h>
+#include <ohm/VoxelTsdf.h>
+
+#include <ohm/private/OccupancyMapDetail.h>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuEvent.h>
+#include <gputil/gpuKernel.h>
+#include <gputil/gpuPlatform.h>
+#include <gputil/gpuProgram.h>
+
+#include <logutil/Logger.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "RegionUpdateResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(regionRayUpdateOccupancyTsdf);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_fused("RegionUpdateTsdf", GpuProgramRef::kSourceString, RegionUpdateCode,  // NOLINT
+                                  RegionUpdateCode_length, { "-DTSDF_FUSED" });
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_fused("RegionUpdateTsdf", GpuProgramRef::kSourceFile, "RegionUpdate.cl", 0u,
+                                  { "-DTSDF_FUSED" });
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+}  // namespace
+
+
+GpuOccupancyTsdfMap::GpuOccupancyTsdfMap(OccupancyMap *map, bool borrowed_map, unsigned expected_element_count,
+                                         size_t gpu_mem_size)
+  : GpuMap(new GpuOccupancyTsdfMapDetail(map, borrowed_map), expected_element_count, gpu_mem_size)
+{
+  // Ensure tsdf layer is present.
+  if (map->layout().layerIndex(default_layer::tsdfLayerName()) == -1)
+  {
+    // Copy and update layout then update in the map.
+    MapLayout layout = map->layout();
+    addTsdf(layout);
+    map->updateLayout(layout);
+  }
+
+  updateMapInfo(map->mapInfo(), detail()->tsdf_options);
+
+  // Cache the correct GPU program.
+  cacheGpuProgram(imp_->support_voxel_mean && map->voxelMeanEnabled(),
+                  imp_->support_traversal && map->traversalEnabled(), true);
+}
+
+
+GpuOccupancyTsdfMap::~GpuOccupancyTsdfMap()
+{
+  GpuOccupancyTsdfMap::releaseGpuProgram();
+}
+
+
+void GpuOccupancyTsdfMap::setTsdfOptions(const TsdfOptions &options)
+{
+  GpuOccupancyTsdfMapDetail *imp = detail();
+  imp->tsdf_options = options;
+  if (imp->map)
+  {
+    updateMapInfo(imp->map->mapInfo(), imp->tsdf_options);
+  }
+}
+
+
+const TsdfOptions &GpuOccupancyTsdfMap::tsdfOptions() const
+{
+  const GpuOccupancyTsdfMapDetail *imp = detail();
+  return imp->tsdf_options;
+}
+
+
+GpuOccupancyTsdfMapDetail *GpuOccupancyTsdfMap::detail()
+{
+  return static_cast<GpuOccupancyTsdfMapDetail *>(imp_);
+}
+
+
+const GpuOccupancyTsdfMapDetail *GpuOccupancyTsdfMap::detail() const
+{
+  return static_cast<const GpuOccupancyTsdfMapDetail *>(imp_);
+}
+
+
+void GpuOccupancyTsdfMap::cacheGpuProgram(bool with_voxel_mean, bool with_traversal, bool force)
+{
+  if (imp_->program_ref)
+  {
+    if (!force && with_voxel_mean == imp_->cached_sub_voxel_program)
+    {
+      return;
+    }
+  }
+
+  releaseGpuProgram();
+
+  GpuCache &gpu_cache = *gpuCache();
+  GpuOccupancyTsdfMapDetail *imp = detail();
+
+  // Ensure the VoxelUploadInfo items match the layers to update.
+  imp->mean_uidx = enableVoxelUpload(int(kGcIdVoxelMean), with_voxel_mean);
+  imp->traversal_uidx = enableVoxelUpload(int(kGcIdTraversal), with_traversal);
+  imp->touch_time_uidx = enableVoxelUpload(int(kGcIdTouchTime), imp->map->touchTimeEnabled());
+  imp->incident_normal_uidx = enableVoxelUpload(int(kGcIdIncidentNormal), imp->map->incidentNormalEnabled());
+  imp->tsdf_uidx = enableVoxelUpload(int(kGcIdTsdf), gpu_cache.layerCache(kGcIdTsdf) != nullptr);
+
+  const GpuLayerCache *occupancy_cache = gpu_cache.layerCache(kGcIdOccupancy);
+  if (!occupancy_cache || imp->tsdf_uidx < 0)
+  {
+    // Not initialised yet. The TSDF layer is added after the base class initialisation.
+    imp->gpu_ok = false;
+    return;
+  }
+
+  if (occupancy_cache->packedOccupancy())
+  {
+    logutil::error("GpuOccupancyTsdfMap does not support packed occupancy.\n");
+    imp->gpu_ok = false;
+    return;
+  }
+
+  imp->gpu_ok = true;
+  imp->cached_sub_voxel_program = with_voxel_mean;
+  imp->program_ref = &g_program_ref_fused;
+  imp->program_gpu = gpu_cache.gpu();
+
+  if (imp->program_ref->addReference(imp->program_gpu))
+  {
+    imp->update_kernel = GPUTIL_MAKE_KERNEL(imp->program_ref->program(imp->program_gpu), regionRayUpdateOccupancyTsdf);
+    imp->update_kernel.calculateOptimalWorkGroupSize();
+    imp->gpu_ok = imp->update_kernel.isValid();
+  }
+  else
+  {
+    imp->gpu_ok = false;
+  }
+}
+
+
+void GpuOccupancyTsdfMap::finaliseBatch(unsigned region_update_flags)
+{
+  const int buf_idx = imp_->next_buffers_index;
+  const OccupancyMapDetail *map = imp_->map->detail();
+  GpuOccupancyTsdfMapDetail *imp = detail();
+
+  GpuCache &gpu_cache = *this->gpuCache();
+  GpuLayerCache &occupancy_layer_cache = *gpu_cache.layerCache(kGcIdOccupancy);
+  GpuLayerCache &tsdf_layer_cache = *gpu_cache.layerCache(kGcIdTsdf);
+  GpuLayerCache *mean_layer_cache = (imp->mean_uidx >= 0) ? gpu_cache.layerCache(kGcIdVoxelMean) : nullptr;
+  GpuLayerCache *traversal_layer_cache = (imp->traversal_uidx >= 0) ? gpu_cache.layerCache(kGcIdTraversal) : nullptr;
+  GpuLayerCache *touch_times_layer_cache =
+    (imp->touch_time_uidx >= 0) ? gpu_cache.layerCache(kGcIdTouchTime) : nullptr;
+  GpuLayerCache *incidents_layer_cache =
+    (imp->incident_normal_uidx >= 0) ? gpu_cache.layerCache(kGcIdIncidentNormal) : nullptr;
+  std::vector<VoxelUploadInfo> &upload_info = imp->voxel_upload_info[buf_idx];
+
+  const gputil::int3 region_dim_gpu = { map->region_voxel_dimensions.x, map->region_voxel_dimensions.y,
+                                        map->region_voxel_dimensions.z };
+  const unsigned voxel_order_gpu = unsigned(imp->map->voxelOrder());
+
+  const unsigned region_count = imp->region_counts[buf_idx];
+  const unsigned ray_count = imp->ray_counts[buf_idx];
+  gputil::Dim3 global_size(ray_count);
+  gputil::Dim3 local_size(std::min<size_t>(imp->update_kernel.optimalWorkGroupSize(), ray_count));
+
+  // Note: we also wait on original_ray_upload_events here as the samples are required to calculate the TSDF distances.
+  gputil::EventList wait({ imp->key_upload_events[buf_idx], imp->ray_upload_events[buf_idx],
+                           imp->original_ray_upload_events[buf_idx], imp->region_key_upload_events[buf_idx] });
+  if (imp->timestamps_upload_events[buf_idx].isValid())
+  {
+    wait.add(imp->timestamps_upload_events[buf_idx]);
+  }
+  for (const VoxelUploadInfo &info : upload_info)
+  {
+    wait.add(info.offset_upload_event);
+    wait.add(info.voxel_upload_event);
+  }
+
+  const auto layer_offsets = [&upload_info](int uidx) -> gputil::Buffer * {
+    return (uidx >= 0) ? &upload_info[uidx].offsets_buffer : nullptr;
+  };
+
+  imp->update_kernel(
+    global_size, local_size, wait, imp->region_update_events[buf_idx], &gpu_cache.gpuQueue(),
+    // Kernel args begin:
+    // Occupancy voxels and offsets.
+    gputil::BufferArg<float>(*occupancy_layer_cache.buffer()),
+    gputil::BufferArg<uint64_t>(upload_info[imp->occupancy_uidx].offsets_buffer),
+    // Mean voxels and offsets.
+    gputil::BufferArg<VoxelMean>(mean_layer_cache ? mean_layer_cache->buffer() : nullptr),
+    gputil::BufferArg<uint64_t>(layer_offsets(imp->mean_uidx)),
+    // Traversal voxels and offsets.
+    gputil::BufferArg<float>(traversal_layer_cache ? traversal_layer_cache->buffer() : nullptr),
+    gputil::BufferArg<uint64_t>(layer_offsets(imp->traversal_uidx)),
+    // Touch times voxels and offsets.
+    gputil::BufferArg<uint32_t>(touch_times_layer_cache ? touch_times_layer_cache->buffer() : nullptr),
+    gputil::BufferArg<uint64_t>(layer_offsets(imp->touch_time_uidx)),
+    // Incident normal voxels and offsets.
+    gputil::BufferArg<uint32_t>(incidents_layer_cache ? incidents_layer_cache->buffer() : nullptr),
+    gputil::BufferArg<uint64_t>(layer_offsets(imp->incident_normal_uidx)),
+    // Region keys and region count
+    gputil::BufferArg<gputil::int3>(imp->region_key_buffers[buf_idx]), region_count,
+    // Ray start/end keys
+    gputil::BufferArg<GpuKey>(imp->key_buffers[buf_idx]),
+    // Ray start end points, local to end voxel and ray count
+    gputil::BufferArg<gputil::float3>(imp->ray_buffers[buf_idx]), ray_count,
+    // Input touch times buffer
+    gputil::BufferArg<uint32_t>((region_update_flags & kRfInternalTimestamps) ? &imp->timestamps_buffers[buf_idx] :
+                                                                               nullptr),
+    // No dirty span tracking.
+    gputil::BufferArg<uint32_t>(nullptr),
+    // Tsdf voxels and offsets.
+    gputil::BufferArg<VoxelTsdf>(*tsdf_layer_cache.buffer()),
+    gputil::BufferArg<uint64_t>(upload_info[imp->tsdf_uidx].offsets_buffer),
+    // Original ray sensor/samples buffer.
+    gputil::BufferArg<gputil::float3>(imp->original_ray_buffers[buf_idx]),
+    // Region dimensions, voxel order, map resolution, ray adjustment (miss), sample adjustment (hit)
+    region_dim_gpu, voxel_order_gpu, float(map->resolution), map->miss_value, map->hit_value,
+    // Occupied threshold, min occupancy, max occupancy, update flags.
+    map->occupancy_threshold_value, map->min_voxel_value, map->max_voxel_value, region_update_flags,
+    // TSDF settings.
+    imp->tsdf_options.max_weight, imp->tsdf_options.default_truncation_distance, imp->tsdf_options.dropoff_epsilon,
+    imp->tsdf_options.sparsity_compensation_factor);
+
+  // Update most recent chunk GPU event.
+  for (const VoxelUploadInfo &info : upload_info)
+  {
+    gpu_cache.layerCache(info.gpu_layer_id)->updateEvents(imp->batch_marker, imp->region_update_events[buf_idx]);
+  }
+
+  imp->region_counts[buf_idx] = 0;
+  // Start a new batch for the GPU layers.
+  imp->batch_marker = occupancy_layer_cache.beginBatch();
+  for (const VoxelUploadInfo &info : upload_info)
+  {
+    if (info.gpu_layer_id != kGcIdOccupancy)
+    {
+      gpu_cache.layerCache(info.gpu_layer_id)->beginBatch(imp->batch_marker);
+    }
+  }
+  imp->next_buffers_index = imp->nextBufferIndex(imp->next_buffers_index);
+}
+}  // namespace ohm
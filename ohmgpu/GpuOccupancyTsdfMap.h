@@ -0,0 +1,68 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef GPUOCCUPANCYTSDFMAP_H
+#define GPUOCCUPANCYTSDFMAP_H
+
+#include "OhmGpuConfig.h"
+
+#include "GpuMap.h"
+
+#include <ohm/VoxelTsdf.h>
+
+namespace ohm
+{
+struct GpuOccupancyTsdfMapDetail;
+
+/// A GPU mapper which updates both occupancy and TSDF voxels in a single traversal of each ray.
+///
+/// This replaces running a @c GpuMap and a @c GpuTsdfMap over the same rays, where each walks the same voxels and
+/// uploads its own copy of the ray data. Here each ray is walked once, updating the TSDF voxel then making the
+/// occupancy update - including voxel mean, traversal, touch time and incident normal layers when present in the map -
+/// for each voxel. The results match running @c GpuMap and @c GpuTsdfMap separately, to within the tolerance of
+/// atomic update contention.
+///
+/// The TSDF update respects the same @c RayFlag values as @c GpuTsdfMap: @c kRfReverseWalk and @c kRfExcludeOrigin .
+/// It continues along the full ray even where the occupancy update stops early for @c kRfStopOnFirstOccupied . The
+/// other @c RayFlag values affect only the occupancy update.
+///
+/// Packed occupancy and @c setAggregateUpdates() are not supported. @c gpuOk() is false when the map uses packed
+/// occupancy.
+class ohmgpu_API GpuOccupancyTsdfMap : public GpuMap
+{
+public:
+  /// Create a @c GpuOccupancyTsdfMap around the given @p map representation. The TSDF layer is added to the map if
+  /// not present.
+  /// @param map The map to wrap.
+  /// @param borrowed_map True to borrow the map, @c false for this object to take ownership.
+  /// @param expected_element_count The expected point count for calls to @c integrateRays(). Used as a hint.
+  /// @param gpu_mem_size Optionally specify the target GPU cache memory to allocate.
+  explicit GpuOccupancyTsdfMap(OccupancyMap *map, bool borrowed_map = true, unsigned expected_element_count = 2048u,
+                               size_t gpu_mem_size = 0u);
+
+  /// Destructor
+  ~GpuOccupancyTsdfMap() override;
+
+  /// Set TSDF mapping options.
+  /// @param options Options to set.
+  void setTsdfOptions(const TsdfOptions &options);
+
+  /// Get the TSDF mapping options.
+  /// @return The current mapping options.
+  const TsdfOptions &tsdfOptions() const;
+
+protected:
+  /// Helper to access the internal pimpl cast to the correct type.
+  GpuOccupancyTsdfMapDetail *detail();
+  /// Helper to access the internal pimpl cast to the correct type.
+  const GpuOccupancyTsdfMapDetail *detail() const;
+
+  void cacheGpuProgram(bool with_voxel_mean, bool with_traversal, bool force) override;
+
+  void finaliseBatch(unsigned region_update_flags) override;
+};
+}  // namespace ohm
+
+#endif  // GPUOCCUPANCYTSDFMAP_H
@@ -0,0 +1,179 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "GpuSecondarySampleMap.h"
+
+#include "private/GpuSecondarySampleMapDetail.h"
+
+#include "GpuCache.h"
+#include "GpuKey.h"
+#include "GpuLayerCache.h"
+
+#include "private/GpuProgramRef.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelSecondarySample.h>
+
+#include <ohm/private/OccupancyMapDetail.h>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuEvent.h>
+#include <gputil/gpuKernel.h>
+#include <gputil/gpuPlatform.h>
+#include <gputil/gpuProgram.h>
+
+#include <algorithm>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "SecondarySampleUpdateResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(secondarySampleUpdate);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_secondary_sample("SecondarySampleUpdate", GpuProgramRef::kSourceString,  // NOLINT
+                                             SecondarySampleUpdateCode, SecondarySampleUpdateCode_length, {});
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref_secondary_sample("SecondarySampleUpdate", GpuProgramRef::kSourceFile,  // NOLINT
+                                             "SecondarySampleUpdate.cl", 0u, {});
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+}  // namespace
+
+
+GpuSecondarySampleMap::GpuSecondarySampleMap(OccupancyMap *map, bool borrowed_map, unsigned expected_element_count,
+                                             size_t gpu_mem_size)
+  : GpuMap(new GpuSecondarySampleMapDetail(map, borrowed_map), expected_element_count, gpu_mem_size)
+{
+  // Ensure the secondary samples layer is present. This reinitialises the GPU cache to include the layer.
+  map->addLayer(default_layer::secondarySamplesLayerName(), [](MapLayout &layout) { addSecondarySamples(layout); });
+
+  for (unsigned i = 0; i < GpuMapDetail::kMaxBuffersCount; ++i)
+  {
+    // We only want the secondary sample data, so clear what the base class added here.
+    imp_->voxel_upload_info[i].clear();
+    detail()->secondary_sample_uidx = int(imp_->voxel_upload_info[i].size());  // Set twice to the same value.
+    imp_->voxel_upload_info[i].emplace_back(VoxelUploadInfo(kGcIdSecondarySample, gpuCache()->gpu()));
+  }
+
+  // Only using secondary samples.
+  imp_->occupancy_uidx = -1;
+  imp_->mean_uidx = -1;
+  imp_->traversal_uidx = -1;
+  imp_->touch_time_uidx = -1;
+  imp_->incident_normal_uidx = -1;
+
+  // Cache the correct GPU program.
+  cacheGpuProgram(false, false, true);
+}
+
+
+GpuSecondarySampleMap::~GpuSecondarySampleMap()
+{
+  GpuSecondarySampleMap::releaseGpuProgram();
+}
+
+
+GpuSecondarySampleMapDetail *GpuSecondarySampleMap::detail()
+{
+  return static_cast<GpuSecondarySampleMapDetail *>(imp_);
+}
+
+
+const GpuSecondarySampleMapDetail *GpuSecondarySampleMap::detail() const
+{
+  return static_cast<const GpuSecondarySampleMapDetail *>(imp_);
+}
+
+
+void GpuSecondarySampleMap::cacheGpuProgram(bool /*with_voxel_mean*/, bool /*with_traversal*/, bool force)
+{
+  if (imp_->program_ref)
+  {
+    if (!force)
+    {
+      return;
+    }
+  }
+
+  releaseGpuProgram();
+
+  GpuCache &gpu_cache = *gpuCache();
+  imp_->gpu_ok = gpu_cache.layerCache(kGcIdSecondarySample) != nullptr;
+  imp_->cached_sub_voxel_program = false;
+
+  imp_->program_ref = &g_program_ref_secondary_sample;
+  imp_->program_gpu = gpu_cache.gpu();
+  imp_->gpu_ok = imp_->program_ref->addReference(imp_->program_gpu) && imp_->gpu_ok;
+
+  if (imp_->gpu_ok)
+  {
+    imp_->update_kernel = GPUTIL_MAKE_KERNEL(imp_->program_ref->program(imp_->program_gpu), secondarySampleUpdate);
+    imp_->update_kernel.calculateOptimalWorkGroupSize();
+    imp_->gpu_ok = imp_->update_kernel.isValid();
+  }
+}
+
+
+void GpuSecondarySampleMap::finaliseBatch(unsigned region_update_flags)
+{
+  (void)region_update_flags;
+  const int buf_idx = imp_->next_buffers_index;
+  const OccupancyMapDetail *map = imp_->map->detail();
+  const GpuSecondarySampleMapDetail *imp = detail();
+
+  GpuCache &gpu_cache = *this->gpuCache();
+  GpuLayerCache &secondary_sample_layer_cache = *gpu_cache.layerCache(kGcIdSecondarySample);
+  const int secondary_sample_uidx = imp->secondary_sample_uidx;
+  const gputil::int3 region_dim_gpu = { map->region_voxel_dimensions.x, map->region_voxel_dimensions.y,
+                                        map->region_voxel_dimensions.z };
+  const unsigned voxel_order_gpu = unsigned(imp_->map->voxelOrder());
+
+  const unsigned region_count = imp_->region_counts[buf_idx];
+  const unsigned ray_count = imp_->ray_counts[buf_idx];
+  gputil::Dim3 global_size(ray_count);
+  gputil::Dim3 local_size(std::min<size_t>(imp_->update_kernel.optimalWorkGroupSize(), ray_count));
+  gputil::EventList wait({ imp_->key_upload_events[buf_idx], imp_->ray_upload_events[buf_idx],
+                           imp_->region_key_upload_events[buf_idx],
+                           imp_->voxel_upload_info[buf_idx][secondary_sample_uidx].offset_upload_event,
+                           imp_->voxel_upload_info[buf_idx][secondary_sample_uidx].voxel_upload_event });
+
+  imp_->update_kernel(
+    global_size, local_size, wait, imp_->region_update_events[buf_idx], &gpu_cache.gpuQueue(),
+    // Kernel args begin:
+    // Secondary sample voxels and offsets.
+    gputil::BufferArg<VoxelSecondarySample>(*secondary_sample_layer_cache.buffer()),
+    gputil::BufferArg<uint64_t>(imp_->voxel_upload_info[buf_idx][secondary_sample_uidx].offsets_buffer),
+    // Region keys and region count
+    gputil::BufferArg<gputil::int3>(imp_->region_key_buffers[buf_idx]), region_count,
+    // Ray start/end keys
+    gputil::BufferArg<GpuKey>(imp_->key_buffers[buf_idx]),
+    // Ray start end points, local to end voxel and ray count
+    gputil::BufferArg<gputil::float3>(imp_->ray_buffers[buf_idx]), ray_count,
+    // Region dimensions, voxel order
+    region_dim_gpu, voxel_order_gpu);
+
+  // Update most recent chunk GPU event.
+  secondary_sample_layer_cache.updateEvents(imp_->batch_marker, imp_->region_update_events[buf_idx]);
+
+  imp_->region_counts[buf_idx] = 0;
+  // Start a new batch for the GPU layers. Follow integrateRays() in sourcing the marker from the occupancy cache, so
+  // the markers do not overlap batches from a primary GpuMap sharing the cache.
+  GpuLayerCache *marker_cache = gpu_cache.layerCache(kGcIdOccupancy);
+  marker_cache = (marker_cache) ? marker_cache : gpu_cache.layerCache(kGcIdTsdf);
+  imp_->batch_marker = (marker_cache) ? marker_cache->beginBatch() : secondary_sample_layer_cache.beginBatch();
+  secondary_sample_layer_cache.beginBatch(imp_->batch_marker);
+  imp_->next_buffers_index = imp_->nextBufferIndex(imp_->next_buffers_index);
+}
+}  // namespace ohm
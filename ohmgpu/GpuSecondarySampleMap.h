@@ -0,0 +1,62 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef GPUSECONDARYSAMPLEMAP_H
+#define GPUSECONDARYSAMPLEMAP_H
+
+#include "OhmGpuConfig.h"
+
+#include "GpuMap.h"
+
+namespace ohm
+{
+struct GpuSecondarySampleMapDetail;
+
+/// A GPU implementation of @c RayMapperSecondarySample , accumulating secondary samples - such as lidar dual returns -
+/// into the @c VoxelSecondarySample layer.
+///
+/// As with @c RayMapperSecondarySample , each ray passed to @c integrateRays() runs from the primary sample to the
+/// secondary sample and only the secondary sample voxel is updated. The map must have the secondary samples layer -
+/// see @c MapFlag::kSecondarySample and @c addSecondarySamples() - and the layer data may be read by either mapper.
+///
+/// This is intended to be used alongside the @c GpuMap which integrates the primary rays, borrowing the same map.
+/// Both share the map's @c GpuCache , so the secondary samples are batched and uploaded as for primary rays without
+/// round tripping through the CPU. Note that @c syncVoxels() must be called on this object in order to synchronise
+/// the secondary sample layer as it is not synchronised by the primary @c GpuMap . Adding the layer reinitialises the
+/// GPU cache, so the @c GpuSecondarySampleMap should be created before integrating any primary rays.
+///
+/// Unlike @c RayMapperSecondarySample , the update is calculated in single precision and secondary samples clipped
+/// by the ray filter are ignored. No @c RayFlag values are respected.
+class ohmgpu_API GpuSecondarySampleMap : public GpuMap
+{
+public:
+  /// Create a @c GpuSecondarySampleMap around the given @p map representation.
+  /// @param map The map to wrap.
+  /// @param borrowed_map True to borrow the map, @c false for this object to take ownership.
+  /// @param expected_element_count The expected point count for calls to @c integrateRays(). Used as a hint.
+  /// @param gpu_mem_size Optionally specify the target GPU cache memory to allocate.
+  explicit GpuSecondarySampleMap(OccupancyMap *map, bool borrowed_map = true, unsigned expected_element_count = 2048u,
+                                 size_t gpu_mem_size = 0u);
+
+  /// Destructor
+  ~GpuSecondarySampleMap() override;
+
+protected:
+  /// Helper to access the internal pimpl cast to the correct type.
+  GpuSecondarySampleMapDetail *detail();
+  /// Helper to access the internal pimpl cast to the correct type.
+  const GpuSecondarySampleMapDetail *detail() const;
+
+  /// Cache the secondary sample kernel.
+  /// @param with_voxel_mean Ignored.
+  /// @param with_traversal Ignored.
+  /// @param force Force release and program caching even if already correct. Must be used on initialisation.
+  void cacheGpuProgram(bool with_voxel_mean, bool with_traversal, bool force) override;
+
+  void finaliseBatch(unsigned region_update_flags) override;
+};
+}  // namespace ohm
+
+#endif  // GPUSECONDARYSAMPLEMAP_H
@@ -7,10 +7,15 @@
 
 #include "private/GpuTransformSamplesDetail.h"
 
+#include "GpuKey.h"
 #include "OhmGpu.h"
 
 #include "private/GpuProgramRef.h"
 
+#include <ohm/Key.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelTouchTime.h>
+
 #include <gputil/gpuEvent.h>
 #include <gputil/gpuEventList.h>
 #include <gputil/gpuKernel.h>
@@ -21,6 +26,7 @@
 #include <glm/ext.hpp>
 
 #include <algorithm>
+#include <array>
 #include <mutex>
 
 #if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
@@ -29,6 +35,7 @@
 
 #if GPUTIL_TYPE == GPUTIL_CUDA
 GPUTIL_CUDA_DECLARE_KERNEL(transformTimestampedPoints);
+GPUTIL_CUDA_DECLARE_KERNEL(transformRays);
 #endif  // GPUTIL_TYPE == GPUTIL_CUDA
 
 namespace ohm
@@ -68,10 +75,15 @@ GpuTransformSamples::GpuTransformSamples(gputil::Device &gpu)
   imp_->transform_positions_buffer = gputil::Buffer(gpu, sizeof(gputil::float3) * 8, gputil::kBfReadHost);
   imp_->transform_rotations_buffer = gputil::Buffer(gpu, sizeof(gputil::float4) * 8, gputil::kBfReadHost);
   imp_->transform_times_buffer = gputil::Buffer(gpu, sizeof(float) * 8, gputil::kBfReadHost);
+  imp_->samples_buffer = gputil::Buffer(gpu, sizeof(gputil::float4) * 8, gputil::kBfReadHost);
+  imp_->counts_buffer = gputil::Buffer(gpu, sizeof(uint32_t) * 2, gputil::kBfReadWriteHost);
+  imp_->regions_buffer = gputil::Buffer(gpu, sizeof(GpuKey) * 8, gputil::kBfReadWriteHost);
   if (g_program_ref.addReference(gpu))
   {
     imp_->kernel = GPUTIL_MAKE_KERNEL(g_program_ref.program(), transformTimestampedPoints);
     imp_->kernel.calculateOptimalWorkGroupSize();
+    imp_->rays_kernel = GPUTIL_MAKE_KERNEL(g_program_ref.program(), transformRays);
+    imp_->rays_kernel.calculateOptimalWorkGroupSize();
   }
 }
 
@@ -88,6 +100,7 @@ GpuTransformSamples::~GpuTransformSamples()
   if (imp_ && imp_->kernel.isValid())
   {
     imp_->kernel = gputil::Kernel();
+    imp_->rays_kernel = gputil::Kernel();
     g_program_ref.releaseReference();
   }
   delete imp_;
@@ -203,4 +216,153 @@ unsigned GpuTransformSamples::transform(const double *transform_times, const glm
 
   return upload_count;
 }
+
+
+unsigned GpuTransformSamples::transformRays(const double *transform_times, const glm::dvec3 *transform_translations,
+                                            const glm::dquat *transform_rotations, unsigned transform_count,
+                                            const double *sample_times, const glm::dvec3 *local_samples,
+                                            unsigned point_count, gputil::Queue &gpu_queue,
+                                            const GpuTransformRaysTarget &target, std::vector<glm::i16vec3> &regions,
+                                            gputil::Event &completion_event)
+{
+  regions.clear();
+  if (point_count == 0 || transform_count == 0 || !target.map || !target.line_keys || !target.local_lines ||
+      !imp_->rays_kernel.isValid())
+  {
+    return 0u;
+  }
+
+  const OccupancyMap &map = *target.map;
+
+  // Wait on outstanding operations to complete.
+  gputil::Event::wait(imp_->upload_events.data(), GpuTransformSamplesDetail::kUploadEventCount);
+
+  // All positions are uploaded relative to the centre of the voxel containing the first transform. This maintains
+  // single precision accuracy near the sensor.
+  const Key reference_key = map.voxelKey(transform_translations[0]);
+  const glm::dvec3 reference_centre = map.voxelCentreGlobal(reference_key);
+
+  // Upload samples with the time relative to the first transform in w.
+  imp_->samples_buffer.elementsResize<gputil::float4>(point_count);
+  gputil::PinnedBuffer samples_pinned(imp_->samples_buffer, gputil::kPinWrite);
+  const double base_time = transform_times[0];
+  const auto max_time = float(transform_times[transform_count - 1] - base_time);
+  gputil::float4 sample{};
+  for (unsigned i = 0; i < point_count; ++i)
+  {
+    sample.x = float(local_samples[i].x);
+    sample.y = float(local_samples[i].y);
+    sample.z = float(local_samples[i].z);
+    sample.w = float(sample_times[i] - base_time);
+    samples_pinned.write(&sample, sizeof(sample), i * sizeof(sample));
+  }
+  samples_pinned.unpin(&gpu_queue, nullptr, &imp_->upload_events[0]);
+
+  // Upload transforms.
+  imp_->transform_positions_buffer.resize(sizeof(gputil::float3) * transform_count);
+  imp_->transform_rotations_buffer.resize(sizeof(gputil::float4) * transform_count);
+  imp_->transform_times_buffer.resize(sizeof(float) * transform_count);
+  gputil::PinnedBuffer positions_buffer(imp_->transform_positions_buffer, gputil::kPinWrite);
+  gputil::PinnedBuffer rotations_buffer(imp_->transform_rotations_buffer, gputil::kPinWrite);
+  gputil::PinnedBuffer times_buffer(imp_->transform_times_buffer, gputil::kPinWrite);
+
+  gputil::float3 position{};
+  gputil::float4 rotation{};
+  float single_precision_timestamp;
+  for (unsigned i = 0; i < transform_count; ++i)
+  {
+    position.x = float(transform_translations[i].x - reference_centre.x);
+    position.y = float(transform_translations[i].y - reference_centre.y);
+    position.z = float(transform_translations[i].z - reference_centre.z);
+    rotation.x = float(transform_rotations[i].x);
+    rotation.y = float(transform_rotations[i].y);
+    rotation.z = float(transform_rotations[i].z);
+    rotation.w = float(transform_rotations[i].w);
+    positions_buffer.write(&position, sizeof(position), i * sizeof(gputil::float3));
+    rotations_buffer.write(&rotation, sizeof(rotation), i * sizeof(gputil::float4));
+    single_precision_timestamp = std::max(0.0f, std::min(float(transform_times[i] - base_time), max_time));
+    times_buffer.write(&single_precision_timestamp, sizeof(single_precision_timestamp),
+                       i * sizeof(single_precision_timestamp));
+  }
+
+  positions_buffer.unpin(&gpu_queue, nullptr, &imp_->upload_events[1]);
+  rotations_buffer.unpin(&gpu_queue, nullptr, &imp_->upload_events[2]);
+  times_buffer.unpin(&gpu_queue, nullptr, &imp_->upload_events[3]);
+
+  // Size the outputs for the worst case: all samples valid.
+  target.line_keys->resize(sizeof(GpuKey) * 2 * point_count);
+  target.local_lines->resize(sizeof(gputil::float3) * 2 * point_count);
+  if (target.original_lines)
+  {
+    target.original_lines->resize(sizeof(gputil::float3) * 2 * point_count);
+  }
+  if (target.touch_times)
+  {
+    target.touch_times->resize(sizeof(uint32_t) * point_count);
+  }
+  if (imp_->regions_buffer.elementCount<GpuKey>() < point_count)
+  {
+    // Most rays touch few regions. We resize and run again on overflow.
+    imp_->regions_buffer.elementsResize<GpuKey>(point_count);
+  }
+
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+  const gputil::int3 region_dim_gpu = { region_dim.x, region_dim.y, region_dim.z };
+  const gputil::int3 reference_region_gpu = { reference_key.regionKey().x, reference_key.regionKey().y,
+                                              reference_key.regionKey().z };
+  const gputil::int3 reference_voxel_gpu = { reference_key.localKey().x, reference_key.localKey().y,
+                                             reference_key.localKey().z };
+  const float touch_time_offset = float(base_time - target.touch_timebase);
+  const auto touch_time_scale = float(1.0 / OHM_VOXEL_TOUCH_TIME_SCALE);
+
+  gputil::Dim3 global_size(point_count);
+  gputil::Dim3 local_size(std::min<size_t>(imp_->rays_kernel.optimalWorkGroupSize(), point_count));
+  gputil::EventList wait(imp_->upload_events.data(), GpuTransformSamplesDetail::kUploadEventCount);
+
+  std::array<uint32_t, 2> counts = { 0, 0 };
+  for (int attempt = 0; attempt < 2; ++attempt)
+  {
+    const std::array<uint32_t, 2> zero = { 0, 0 };
+    imp_->counts_buffer.write(zero.data(), sizeof(zero));
+    const auto max_regions = unsigned(imp_->regions_buffer.elementCount<GpuKey>());
+
+    imp_->rays_kernel(global_size, local_size, wait, completion_event, &gpu_queue,
+                      // Kernel args begin:
+                      gputil::BufferArg<gputil::float4>(imp_->samples_buffer), point_count,
+                      gputil::BufferArg<float>(imp_->transform_times_buffer),
+                      gputil::BufferArg<gputil::float3>(imp_->transform_positions_buffer),
+                      gputil::BufferArg<gputil::float4>(imp_->transform_rotations_buffer), transform_count,
+                      reference_region_gpu, reference_voxel_gpu, region_dim_gpu, float(map.resolution()),
+                      float(target.max_range), touch_time_offset, touch_time_scale,
+                      gputil::BufferArg<GpuKey>(*target.line_keys),
+                      gputil::BufferArg<gputil::float3>(*target.local_lines),
+                      gputil::BufferArg<gputil::float3>(target.original_lines),
+                      gputil::BufferArg<uint32_t>(target.touch_times),
+                      gputil::BufferArg<uint32_t>(imp_->counts_buffer),
+                      gputil::BufferArg<GpuKey>(imp_->regions_buffer), max_regions);
+
+    imp_->counts_buffer.read(counts.data(), sizeof(counts), 0, nullptr, &completion_event);
+    if (counts[1] <= max_regions)
+    {
+      break;
+    }
+
+    imp_->regions_buffer.elementsResize<GpuKey>(counts[1]);
+  }
+
+  if (counts[0] == 0)
+  {
+    return 0u;
+  }
+
+  std::vector<GpuKey> region_keys(counts[1]);
+  imp_->regions_buffer.read(region_keys.data(), region_keys.size() * sizeof(GpuKey), 0, nullptr, &completion_event);
+  regions.reserve(region_keys.size());
+  for (const GpuKey &key : region_keys)
+  {
+    regions.emplace_back(glm::i16vec3(key.region[0], key.region[1], key.region[2]));
+  }
+
+  return counts[0];
+}
 }  // namespace ohm
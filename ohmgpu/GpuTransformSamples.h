@@ -8,9 +8,12 @@
 
 #include "OhmGpuConfig.h"
 
+#include <ohmutil/TrajectoryIndex.h>
+
 #include <glm/fwd.hpp>
 
 #include <limits>
+#include <vector>
 
 namespace gputil
 {
@@ -22,8 +25,28 @@ class Queue;
 
 namespace ohm
 {
+class OccupancyMap;
 struct GpuTransformSamplesDetail;
 
+/// Output buffers and map parameters for @c GpuTransformSamples::transformRays() .
+struct ohmgpu_API GpuTransformRaysTarget
+{
+  /// Map defining the voxel layout for the output keys.
+  const OccupancyMap *map = nullptr;
+  /// Output ray start/end @c GpuKey pairs. Resized as required.
+  gputil::Buffer *line_keys = nullptr;
+  /// Output rays as @c gputil::float3 pairs relative to the end voxel centre. Resized as required.
+  gputil::Buffer *local_lines = nullptr;
+  /// Optional copy of @c local_lines . Resized as required.
+  gputil::Buffer *original_lines = nullptr;
+  /// Optional encoded touch time for each ray - see @c encodeVoxelTouchTime() . Resized as required.
+  gputil::Buffer *touch_times = nullptr;
+  /// Time base used to encode @c touch_times .
+  double touch_timebase = 0;
+  /// Samples further than this from the sensor are rejected.
+  double max_range = std::numeric_limits<double>::infinity();
+};
+
 /// A utility class for transforming local samples into a global frame using the Gpu.
 ///
 /// See @c transform() for details.
@@ -78,6 +101,55 @@ public:
                      gputil::Buffer &output_buffer, gputil::Event &completion_event,
                      double max_range = std::numeric_limits<double>::infinity());
 
+  /// Overload transforming samples using the poses of a @c TrajectoryIndex .
+  ///
+  /// @param trajectory The trajectory which provides the local to global transforms.
+  /// @param sample_times Array of timestamps for @p local_samples.
+  /// @param local_samples The sample points to transform in local sensor space.
+  /// @param point_count Number of items in @p local_samples and @p sample_times.
+  /// @param gpu_queue The queue in which to execute the GPU operations.
+  /// @param output_buffer GPU buffer to calculate the results in. Will be resized if too small.
+  /// @param completion_event Event which may be used to monitor GPU completion of the translations.
+  /// @param max_range Maximum allowed distance length of a valid ray (sensor to sample distance).
+  /// @return The number of valid samples queued for translation on GPU.
+  inline unsigned transform(const TrajectoryIndex &trajectory, const double *sample_times,
+                            const glm::dvec3 *local_samples, unsigned point_count, gputil::Queue &gpu_queue,
+                            gputil::Buffer &output_buffer, gputil::Event &completion_event,
+                            double max_range = std::numeric_limits<double>::infinity())
+  {
+    return transform(trajectory.times(), trajectory.positions(), trajectory.rotations(), unsigned(trajectory.count()),
+                     sample_times, local_samples, point_count, gpu_queue, output_buffer, completion_event, max_range);
+  }
+
+  /// Transform local samples into map rays for direct use by the @c GpuMap region update kernels.
+  ///
+  /// This extends @c transform() by also filtering the rays and resolving the ray voxel keys on GPU, writing the
+  /// results directly into the @p target buffers. Bad samples - infinite or NaN - and samples beyond the
+  /// @c GpuTransformRaysTarget::max_range are rejected on GPU; there is no support for a custom @c RayFilterFunction .
+  /// The keys of the map regions touched by the rays are downloaded into @p regions as these are required to manage
+  /// the @c GpuCache . The transformed rays are not downloaded.
+  ///
+  /// This call blocks until the GPU completes the transformation in order to resolve the @p regions .
+  ///
+  /// @param transform_times Array of timestamps for the local to global transforms.
+  /// @param transform_translations Array of translation components of the local to global transforms.
+  /// @param transform_rotations Array of quaternion rotations of the local to global transforms.
+  /// @param transform_count number of entries in @p transform_times, @p transform_translations and
+  ///   @p transform_rotations.
+  /// @param sample_times Array of timestamps for @p local_samples.
+  /// @param local_samples The sample points to transform in local sensor space.
+  /// @param point_count Number of items in @p local_samples and @p sample_times.
+  /// @param gpu_queue The queue in which to execute the GPU operations.
+  /// @param target Defines the output buffers.
+  /// @param regions Populated with the keys of the regions touched by the rays. May contain duplicates.
+  /// @param completion_event Event marking completion of the GPU writes to the @p target buffers.
+  /// @return The number of valid rays written to the @p target buffers.
+  unsigned transformRays(const double *transform_times, const glm::dvec3 *transform_translations,
+                         const glm::dquat *transform_rotations, unsigned transform_count, const double *sample_times,
+                         const glm::dvec3 *local_samples, unsigned point_count, gputil::Queue &gpu_queue,
+                         const GpuTransformRaysTarget &target, std::vector<glm::i16vec3> &regions,
+                         gputil::Event &completion_event);
+
 private:
   GpuTransformSamplesDetail *imp_;
 };
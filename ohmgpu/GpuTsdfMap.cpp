@@ -76,7 +76,7 @@ GpuTsdfMap::GpuTsdfMap(OccupancyMap *map, bool borrowed_map, unsigned expected_e
   }
 
   // Buffer management is a bit messy because it's a retrofit.
-  for (int i = 0; i < 2; ++i)
+  for (unsigned i = 0; i < GpuMapDetail::kMaxBuffersCount; ++i)
   {
     // We only want TSDF data, so clear what the base class added here.
     imp_->voxel_upload_info[i].clear();
@@ -222,11 +222,12 @@ void GpuTsdfMap::cacheGpuProgram(bool /*with_voxel_mean*/, bool /*with_traversal
   imp->cached_sub_voxel_program = true;
 
   imp->program_ref = &g_program_ref_tsdf;
-  imp->gpu_ok = imp->program_ref->addReference(gpu_cache.gpu()) && imp_->gpu_ok;
+  imp->program_gpu = gpu_cache.gpu();
+  imp->gpu_ok = imp->program_ref->addReference(imp->program_gpu) && imp_->gpu_ok;
 
   if (imp_->gpu_ok)
   {
-    imp->update_kernel = GPUTIL_MAKE_KERNEL(imp->program_ref->program(), tsdfRayUpdate);
+    imp->update_kernel = GPUTIL_MAKE_KERNEL(imp->program_ref->program(imp->program_gpu), tsdfRayUpdate);
   }
 
   if (imp_->gpu_ok)
@@ -250,6 +251,7 @@ void GpuTsdfMap::finaliseBatch(unsigned region_update_flags)
   // Enqueue update kernel.
   const gputil::int3 region_dim_gpu = { map->region_voxel_dimensions.x, map->region_voxel_dimensions.y,
                                         map->region_voxel_dimensions.z };
+  const unsigned voxel_order_gpu = unsigned(imp->map->voxelOrder());
 
   if (!imp_->use_original_ray_buffers)
   {
@@ -283,8 +285,8 @@ void GpuTsdfMap::finaliseBatch(unsigned region_update_flags)
                       gputil::BufferArg<gputil::float3>(imp_->ray_buffers[buf_idx]),
                       // Original ray sensor/samples buffer.
                       gputil::BufferArg<gputil::float3>(imp_->original_ray_buffers[buf_idx]), ray_count,
-                      // Region dimensions, map resolution, TSDF settings.
-                      region_dim_gpu, float(map->resolution), imp->tsdf_options.max_weight,
+                      // Region dimensions, voxel order, map resolution, TSDF settings.
+                      region_dim_gpu, voxel_order_gpu, float(map->resolution), imp->tsdf_options.max_weight,
                       imp->tsdf_options.default_truncation_distance, imp->tsdf_options.dropoff_epsilon,
                       imp->tsdf_options.sparsity_compensation_factor, region_update_flags);
 
@@ -296,6 +298,6 @@ void GpuTsdfMap::finaliseBatch(unsigned region_update_flags)
   imp_->region_counts[buf_idx] = 0;
   // Start a new batch for the GPU layers.
   imp_->batch_marker = tsdf_layer_cache.beginBatch();
-  imp_->next_buffers_index = (imp_->next_buffers_index + 1) % GpuMapDetail::kBuffersCount;
+  imp_->next_buffers_index = imp_->nextBufferIndex(imp_->next_buffers_index);
 }
 }  // namespace ohm
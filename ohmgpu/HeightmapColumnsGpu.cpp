@@ -0,0 +1,372 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "HeightmapColumnsGpu.h"
+
+#include "GpuCache.h"
+#include "GpuKey.h"
+#include "GpuLayerCache.h"
+#include "GpuMap.h"
+
+#include "private/GpuProgramRef.h"
+
+#include "gpu/HeightmapColumnsResult.h"
+
+#include <ohm/MapLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <gputil/gpuPinnedBuffer.h>
+#include <gputil/gpuPlatform.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "HeightmapColumnsResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(heightmapColumns);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("HeightmapColumns", GpuProgramRef::kSourceString,  // NOLINT
+                            HeightmapColumnsCode, HeightmapColumnsCode_length);
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("HeightmapColumns", GpuProgramRef::kSourceFile, "HeightmapColumns.cl", 0u);
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+/// Binary mirror of @c ohm::HeightmapVoxel . The ohmgpu library does not depend on ohmheightmap.
+struct alignas(8) HeightmapColumnVoxel
+{
+  float height;
+  float clearance;
+  float normal_x;
+  float normal_y;
+  float normal_z;
+  uint8_t layer;
+  uint8_t flags;
+  uint16_t contributing_samples;
+};
+
+static_assert(sizeof(HeightmapColumnVoxel) == 24, "HeightmapColumnVoxel must match HeightmapVoxel");
+
+/// Heightmap occupancy value for a real surface. Matches @c Heightmap::kHeightmapSurfaceValue .
+constexpr float kSurfaceValue = 1.0f;
+/// Heightmap occupancy value for a virtual surface. Matches @c Heightmap::kHeightmapVirtualSurfaceValue .
+constexpr float kVirtualSurfaceValue = -1.0f;
+/// Heightmap occupancy value for a vacant column. Matches @c Heightmap::kHeightmapVacantValue .
+constexpr float kVacantValue = 0.0f;
+/// Matches @c HeightmapVoxelFlag::kHvfObservedAbove .
+constexpr uint8_t kObservedAboveFlag = 1u;
+
+/// Global voxel index of @p key along @p axis .
+int globalAxisIndex(const Key &key, int axis, const glm::ivec3 &region_dim)
+{
+  return int(key.regionKey()[axis]) * region_dim[axis] + int(key.localKey()[axis]);
+}
+
+
+/// Resolve the voxel key at @p height along @p up_axis , aligned to the lower corner of the @p region_key footprint.
+Key columnKey(const OccupancyMap &map, const glm::i16vec3 &region_key, int up_axis, double height)
+{
+  glm::dvec3 pos = map.regionSpatialCentre(region_key);
+  pos[up_axis] = height;
+  Key key = map.voxelKey(pos);
+  for (int i = 1; i < 3; ++i)
+  {
+    const int axis = (up_axis + i) % 3;
+    key.setRegionAxis(axis, region_key[axis]);
+    key.setLocalAxis(axis, 0);
+  }
+  return key;
+}
+}  // namespace
+
+HeightmapColumnsGpu::HeightmapColumnsGpu(gputil::Device &gpu)
+  : gpu_(gpu)
+{
+  gpu_base_key_ = gputil::Buffer(gpu, sizeof(GpuKey), gputil::kBfReadHost);
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  gpu_region_keys_ = gputil::Buffer(gpu, 8 * sizeof(gputil::int3), gputil::kBfReadHost);
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  gpu_occupancy_region_offsets_ = gputil::Buffer(gpu, 8 * sizeof(uint64_t), gputil::kBfReadHost);
+  gpu_results_ = gputil::Buffer(gpu, sizeof(HeightmapColumnsResult), gputil::kBfWriteHost);
+}
+
+
+HeightmapColumnsGpu::~HeightmapColumnsGpu()
+{
+  gpu_base_key_ = gputil::Buffer();
+  gpu_region_keys_ = gputil::Buffer();
+  gpu_occupancy_region_offsets_ = gputil::Buffer();
+  gpu_results_ = gputil::Buffer();
+  releaseGpuProgram();
+  gpu_ = gputil::Device();
+}
+
+
+bool HeightmapColumnsGpu::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &region_key,
+                                             double reference_height)
+{
+  results_.clear();
+
+  cacheGpuProgram(false);
+  if (!columns_kernel_.isValid())
+  {
+    return false;
+  }
+
+  const int axis0 = (up_axis_ + 1) % 3;
+  const int axis1 = (up_axis_ + 2) % 3;
+  const glm::ivec3 region_dim = map.regionVoxelDimensions();
+  const double region_height = map.regionSpatialResolution()[up_axis_];
+
+  // Resolve the column range: from the floor to the ceiling plus clearance, with one additional voxel to ensure the
+  // clearance above a voxel at the ceiling can be resolved.
+  const double below = (floor_ > 0) ? floor_ : region_height;
+  const double above = (ceiling_ > 0) ? ceiling_ : region_height;
+  const int clearance_voxels = int(std::ceil(min_clearance_ / map.resolution()));
+  const Key base_key = columnKey(map, region_key, up_axis_, reference_height - below);
+  const Key reference_key = columnKey(map, region_key, up_axis_, reference_height);
+  const Key ceiling_key = columnKey(map, region_key, up_axis_, reference_height + above);
+  const Key top_key =
+    columnKey(map, region_key, up_axis_, reference_height + above + (clearance_voxels + 1) * map.resolution());
+
+  const int base_index = globalAxisIndex(base_key, up_axis_, region_dim);
+  const int column_height = globalAxisIndex(top_key, up_axis_, region_dim) - base_index + 1;
+  const int search_top = globalAxisIndex(ceiling_key, up_axis_, region_dim) - base_index;
+  const int reference_index = globalAxisIndex(reference_key, up_axis_, region_dim) - base_index;
+
+  GpuCache *gpu_cache = initialiseGpuCache(map, GpuCache::kDefaultTargetMemSize, gpumap::kGpuAllowMappedBuffers);
+  GpuLayerCache *occupancy_cache = gpu_cache->layerCache(kGcIdOccupancy);
+  if (occupancy_cache->packedOccupancy())
+  {
+    std::cerr << "HeightmapColumnsGpu: packed occupancy GPU cache not supported.\n" << std::flush;
+    return false;
+  }
+
+  const int region_min = base_key.regionKey()[up_axis_];
+  const int region_max = top_key.regionKey()[up_axis_];
+  gpu_region_keys_.elementsResize<gputil::int3>(region_max - region_min + 1);
+  gpu_occupancy_region_offsets_.elementsResize<uint64_t>(region_max - region_min + 1);
+
+  const GpuKey gpu_key = { base_key.regionKey().x, base_key.regionKey().y, base_key.regionKey().z,
+                           base_key.localKey().x,  base_key.localKey().y,  base_key.localKey().z };
+  gpu_base_key_.write(&gpu_key, sizeof(gpu_key));
+
+  // Upload the vertical stack of regions. Missing regions are skipped and treated as unobserved by the kernel.
+  std::vector<gputil::Event> upload_events;
+  gputil::PinnedBuffer region_keys(gpu_region_keys_, gputil::kPinWrite);
+  gputil::PinnedBuffer occupancy_region_offsets(gpu_occupancy_region_offsets_, gputil::kPinWrite);
+  const unsigned batch_marker = occupancy_cache->beginBatch();
+  unsigned region_count = 0;
+  for (int r = region_min; r <= region_max; ++r)
+  {
+    glm::i16vec3 current_region_coord = region_key;
+    current_region_coord[up_axis_] = int16_t(r);
+    MapChunk *chunk = map.region(current_region_coord);
+    if (!chunk)
+    {
+      continue;
+    }
+
+    gputil::Event upload_event;
+    size_t lookup_offset = 0;
+    uint64_t occupancy_mem_offset = 0;
+    if (occupancy_cache->lookup(map, current_region_coord, &lookup_offset, &upload_event))
+    {
+      occupancy_mem_offset = lookup_offset;
+    }
+    else
+    {
+      GpuLayerCache::CacheStatus status;
+      occupancy_mem_offset = occupancy_cache->upload(map, current_region_coord, chunk, &upload_event, &status,
+                                                     batch_marker, GpuLayerCache::kSkipDownload);
+      if (status == GpuLayerCache::kCacheFull)
+      {
+        std::cerr << "HeightmapColumnsGpu: GPU cache full. Results invalid.\n" << std::flush;
+        return false;
+      }
+    }
+
+    upload_events.emplace_back(upload_event);
+    const glm::ivec3 region_coord_gpu = current_region_coord;
+    region_keys.write(glm::value_ptr(region_coord_gpu), sizeof(region_coord_gpu), region_count * sizeof(gputil::int3));
+    occupancy_region_offsets.write(&occupancy_mem_offset, sizeof(occupancy_mem_offset),
+                                   region_count * sizeof(uint64_t));
+    ++region_count;
+  }
+  region_keys.unpin();
+  occupancy_region_offsets.unpin();
+
+  region_key_ = region_key;
+  reference_height_ = reference_height;
+
+  const size_t column_count = size_t(region_dim[axis0]) * size_t(region_dim[axis1]);
+  gpu_results_.elementsResize<HeightmapColumnsResult>(column_count * max_layers_);
+
+  const gputil::int3 region_dim_gpu = { region_dim.x, region_dim.y, region_dim.z };
+  const gputil::int3 axes_gpu = { axis0, axis1, up_axis_ };
+  const auto voxel_order = unsigned(map.layerVoxelOrder(map.layout().occupancyLayer()));
+  unsigned kernel_flags = 0;
+  kernel_flags |= (virtual_surfaces_) ? HC_FlagVirtualSurfaces : 0u;
+  kernel_flags |= (max_layers_ > 1) ? HC_FlagLayered : 0u;
+
+  gputil::Dim3 global_size;
+  gputil::Dim3 local_size;
+  columns_kernel_.calculateGrid(&global_size, &local_size,
+                                gputil::Dim3(size_t(region_dim[axis0]), size_t(region_dim[axis1]), 1));
+
+  gputil::Event::wait(upload_events.data(), upload_events.size());
+
+  gputil::Queue &queue = gpu_cache->gpuQueue();
+  gputil::Event kernel_event;
+  const int err = columns_kernel_(
+    global_size, local_size, kernel_event, &queue,
+    // Kernel arguments
+    gputil::BufferArg<float>(*occupancy_cache->buffer()), gputil::BufferArg<uint64_t>(gpu_occupancy_region_offsets_),
+    gputil::BufferArg<gputil::int3>(gpu_region_keys_), region_count, region_dim_gpu, voxel_order,
+    map.occupancyThresholdValue(), gputil::BufferArg<GpuKey>(gpu_base_key_), axes_gpu, column_height, search_top,
+    reference_index, clearance_voxels, kernel_flags, int(max_layers_),
+    gputil::BufferArg<HeightmapColumnsResult>(gpu_results_));
+
+  if (err)
+  {
+    return false;
+  }
+
+  kernel_event.wait();
+
+  // Download and convert the results.
+  std::vector<HeightmapColumnsResult> gpu_results(column_count * max_layers_);
+  gputil::PinnedBuffer results_buffer(gpu_results_, gputil::kPinRead);
+  results_buffer.read(gpu_results.data(), gpu_results.size() * sizeof(*gpu_results.data()));
+  results_buffer.unpin();
+
+  results_.resize(gpu_results.size());
+  for (size_t i = 0; i < gpu_results.size(); ++i)
+  {
+    const HeightmapColumnsResult &gpu_result = gpu_results[i];
+    Candidate &candidate = results_[i];
+    candidate.type = CandidateType(gpu_result.type);
+    if (candidate.type == kNone)
+    {
+      continue;
+    }
+
+    const size_t column_index = i / max_layers_;
+    candidate.key = base_key;
+    map.moveKeyAlongAxis(candidate.key, axis0, int(column_index % size_t(region_dim[axis0])));
+    map.moveKeyAlongAxis(candidate.key, axis1, int(column_index / size_t(region_dim[axis0])));
+    map.moveKeyAlongAxis(candidate.key, up_axis_, gpu_result.voxel_index);
+    candidate.clearance = gpu_result.clearance_voxels * map.resolution();
+    candidate.observed_above = (gpu_result.flags & HC_ResultObservedAbove) != 0;
+  }
+
+  return true;
+}
+
+
+bool HeightmapColumnsGpu::writeHeightmap(const OccupancyMap &map, OccupancyMap &heightmap, int heightmap_layer) const
+{
+  const MapLayer *layer = heightmap.layout().layerPtr(heightmap_layer);
+  if (results_.empty() || !layer || layer->voxelByteSize() != sizeof(HeightmapColumnVoxel))
+  {
+    return false;
+  }
+
+  const int axis0 = (up_axis_ + 1) % 3;
+  const int axis1 = (up_axis_ + 2) % 3;
+  const glm::ivec3 region_dim = map.regionVoxelDimensions();
+  const Key base_key = columnKey(map, region_key_, up_axis_, reference_height_);
+
+  Voxel<float> hm_occupancy(&heightmap, heightmap.layout().occupancyLayer());
+  Voxel<HeightmapColumnVoxel> hm_voxel(&heightmap, heightmap_layer);
+  for (int j = 0; j < region_dim[axis1]; ++j)
+  {
+    for (int i = 0; i < region_dim[axis0]; ++i)
+    {
+      const Candidate &candidate = results_[(size_t(j) * size_t(region_dim[axis0]) + size_t(i)) * max_layers_];
+
+      Key column_key = base_key;
+      map.moveKeyAlongAxis(column_key, axis0, i);
+      map.moveKeyAlongAxis(column_key, axis1, j);
+      const glm::dvec3 src_pos = map.voxelCentreGlobal((candidate.type != kNone) ? candidate.key : column_key);
+
+      Key hm_key = heightmap.voxelKey(src_pos);
+      hm_key.setRegionAxis(up_axis_, 0);
+      hm_key.setLocalAxis(up_axis_, 0);
+      setVoxelKey(hm_key, hm_occupancy, hm_voxel);
+      if (!hm_occupancy.isValid() || !hm_voxel.isValid())
+      {
+        return false;
+      }
+
+      HeightmapColumnVoxel voxel{};
+      voxel.height = (candidate.type != kNone) ?
+                       float(src_pos[up_axis_] - heightmap.voxelCentreGlobal(hm_key)[up_axis_]) :
+                       0.0f;
+      voxel.clearance = float(candidate.clearance);
+      voxel.flags = (candidate.observed_above) ? kObservedAboveFlag : uint8_t(0u);
+      hm_voxel.write(voxel);
+      hm_occupancy.write((candidate.type == kSurface) ?
+                           kSurfaceValue :
+                           ((candidate.type == kVirtualSurface) ? kVirtualSurfaceValue : kVacantValue));
+    }
+  }
+
+  return true;
+}
+
+
+void HeightmapColumnsGpu::cacheGpuProgram(bool force)
+{
+  if (!force && program_ref_ != nullptr)
+  {
+    // Already loaded.
+    return;
+  }
+
+  releaseGpuProgram();
+
+  program_ref_ = &g_program_ref;
+  if (program_ref_->addReference(gpu_))
+  {
+    columns_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), heightmapColumns);
+    if (!columns_kernel_.isValid())
+    {
+      releaseGpuProgram();
+    }
+    else
+    {
+      columns_kernel_.calculateOptimalWorkGroupSize();
+    }
+  }
+}
+
+
+void HeightmapColumnsGpu::releaseGpuProgram()
+{
+  columns_kernel_ = gputil::Kernel();
+
+  if (program_ref_)
+  {
+    program_ref_->releaseReference();
+    program_ref_ = nullptr;
+  }
+}
+}  // namespace ohm
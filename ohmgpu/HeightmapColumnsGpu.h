@@ -0,0 +1,170 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_HEIGHTMAPCOLUMNSGPU_H
+#define OHMGPU_HEIGHTMAPCOLUMNSGPU_H
+
+#include "OhmGpuConfig.h"
+
+#include <ohm/Key.h>
+
+#include <glm/glm.hpp>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuKernel.h>
+
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+class GpuProgramRef;
+
+/// GPU algorithm to extract heightmap surface candidates from the vertical voxel columns of a single region footprint.
+///
+/// This performs the per column ground search of a heightmap on GPU using the occupancy voxels held in (or uploaded
+/// to) the map's @c GpuLayerCache . The region to process is specified by its key in @c calculateForRegion() : the
+/// footprint of that region in the plane perpendicular to the @c upAxis() defines the columns, while all the regions
+/// stacked along the up axis which overlap the search range are uploaded.
+///
+/// The search range is defined relative to a reference height by the @c floor() and @c ceiling() values. A surface
+/// candidate is either an occupied voxel or, with @c virtualSurfaces() enabled, a free voxel supported by an
+/// unobserved voxel. Candidates require @c minClearance() of non-occupied space above them. In planar mode - the
+/// default - a single candidate is selected per column, closest to the reference height. With @c maxLayers() greater
+/// than one, the search is layered and generates up to that many candidates per column.
+///
+/// Results may be inspected via @c results() or written to a heightmap using @c writeHeightmap() . This class does not
+/// depend on the @c ohmheightmap library so the heightmap layer content is written in a binary compatible format with
+/// @c ohm::HeightmapVoxel .
+class ohmgpu_API HeightmapColumnsGpu
+{
+public:
+  /// Candidate type identifiers.
+  enum CandidateType : int
+  {
+    kNone = 0,           ///< No candidate.
+    kSurface = 1,        ///< Occupied voxel surface.
+    kVirtualSurface = 2  ///< Free voxel supported by an unobserved voxel.
+  };
+
+  /// A surface candidate extracted from a column.
+  struct Candidate
+  {
+    /// The candidate voxel key in the source map. Null for @c kNone .
+    Key key = Key::kNull;
+    /// Clearance above the candidate voxel (metres).
+    double clearance = 0;
+    /// The candidate type.
+    CandidateType type = kNone;
+    /// True if an observed voxel exists above the candidate.
+    bool observed_above = false;
+  };
+
+  /// Constructor.
+  /// @param gpu The GPU device to use.
+  explicit HeightmapColumnsGpu(gputil::Device &gpu);
+  /// Destructor.
+  ~HeightmapColumnsGpu();
+
+  /// Set the index of the up axis (0, 1, 2 => x, y, z). Negative axes are not supported; use the positive axis.
+  /// @param axis The up axis index.
+  inline void setUpAxis(int axis) { up_axis_ = axis; }
+  /// Query the index of the up axis.
+  /// @return The up axis index.
+  inline int upAxis() const { return up_axis_; }
+
+  /// Set the distance below the reference height to search for surfaces (metres). Non-positive values search one
+  /// region height below the reference.
+  /// @param floor The floor distance.
+  inline void setFloor(double floor) { floor_ = floor; }
+  /// Query the distance below the reference height to search for surfaces (metres).
+  /// @return The floor distance.
+  inline double floor() const { return floor_; }
+
+  /// Set the distance above the reference height to search for surfaces (metres). Non-positive values search one
+  /// region height above the reference.
+  /// @param ceiling The ceiling distance.
+  inline void setCeiling(double ceiling) { ceiling_ = ceiling; }
+  /// Query the distance above the reference height to search for surfaces (metres).
+  /// @return The ceiling distance.
+  inline double ceiling() const { return ceiling_; }
+
+  /// Set the minimum clearance required above a surface candidate (metres).
+  /// @param clearance The required clearance.
+  inline void setMinClearance(double clearance) { min_clearance_ = clearance; }
+  /// Query the minimum clearance required above a surface candidate (metres).
+  /// @return The required clearance.
+  inline double minClearance() const { return min_clearance_; }
+
+  /// Enable generation of virtual surface candidates.
+  /// @param enable True to enable virtual surfaces.
+  inline void setVirtualSurfaces(bool enable) { virtual_surfaces_ = enable; }
+  /// Query whether virtual surface candidates are generated.
+  /// @return True if virtual surfaces are enabled.
+  inline bool virtualSurfaces() const { return virtual_surfaces_; }
+
+  /// Set the maximum number of candidates per column. One for planar heightmaps, more for layered heightmaps.
+  /// @param max_layers Maximum candidates per column. Clamped to at least one.
+  inline void setMaxLayers(unsigned max_layers) { max_layers_ = (max_layers) ? max_layers : 1u; }
+  /// Query the maximum number of candidates per column.
+  /// @return The maximum candidates per column.
+  inline unsigned maxLayers() const { return max_layers_; }
+
+  /// Extract the surface candidates for the columns of @p region_key in @p map . The up axis component of
+  /// @p region_key is ignored.
+  ///
+  /// @param map The source occupancy map.
+  /// @param region_key Identifies the region footprint to process.
+  /// @param reference_height The reference height along the up axis (metres) from which the @c floor() and
+  ///   @c ceiling() are measured.
+  /// @return True on success, false if the GPU program is unavailable or the cache cannot hold the required regions.
+  bool calculateForRegion(OccupancyMap &map, const glm::i16vec3 &region_key, double reference_height);
+
+  /// Access the results of the last @c calculateForRegion() call. There are @c maxLayers() entries for each column,
+  /// ordered by column with the first horizontal axis varying fastest. Layered candidates are ordered from highest to
+  /// lowest, with unused entries marked @c kNone .
+  /// @return The column candidates.
+  inline const std::vector<Candidate> &results() const { return results_; }
+
+  /// Write the @c results() of a planar query into the @p heightmap . The heightmap must be a 2D map matching the
+  /// source map resolution with the heightmap voxels stored in @p heightmap_layer , which must contain
+  /// @c ohm::HeightmapVoxel sized voxels. Heightmap voxels are set to occupied for surfaces, -1 for virtual surfaces
+  /// and free for vacant columns. Only the first candidate for each column is written.
+  ///
+  /// @param map The source map used in the last @c calculateForRegion() call.
+  /// @param heightmap The heightmap to write to.
+  /// @param heightmap_layer Index of the @c HeightmapVoxel layer in @p heightmap .
+  /// @return True on success, false if the layer is invalid or there are no results.
+  bool writeHeightmap(const OccupancyMap &map, OccupancyMap &heightmap, int heightmap_layer) const;
+
+private:
+  void cacheGpuProgram(bool force);
+  void releaseGpuProgram();
+
+  gputil::Device gpu_;
+  gputil::Kernel columns_kernel_;
+  GpuProgramRef *program_ref_ = nullptr;
+  /// Key of the lowest corner voxel of the columns.
+  gputil::Buffer gpu_base_key_;
+  /// Array of keys of the uploaded regions.
+  gputil::Buffer gpu_region_keys_;
+  /// Memory offsets into the GPU cache memory holding voxel occupancy values. Order matches @c gpu_region_keys_.
+  gputil::Buffer gpu_occupancy_region_offsets_;
+  /// Kernel results buffer.
+  gputil::Buffer gpu_results_;
+  std::vector<Candidate> results_;
+  glm::i16vec3 region_key_{ 0 };
+  double floor_ = 0;
+  double ceiling_ = 0;
+  double min_clearance_ = 0;
+  double reference_height_ = 0;
+  int up_axis_ = 2;
+  unsigned max_layers_ = 1;
+  bool virtual_surfaces_ = false;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_HEIGHTMAPCOLUMNSGPU_H
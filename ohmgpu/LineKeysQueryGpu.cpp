@@ -99,6 +99,7 @@ bool initialiseGpu(LineKeysQueryDetailGpu &query)
   // Initialise buffer to dummy size. We'll resize as required.
   query.lines_out = gputil::Buffer(query.gpu, 1 * kGpuKeySize, gputil::kBfReadWriteHost);
   query.line_points = gputil::Buffer(query.gpu, 1 * sizeof(gputil::float3), gputil::kBfReadHost);
+  query.memory_consumer = GpuMemoryConsumer(GpuMemoryArbiter::forDevice(query.gpu), "LineKeysQueryGpu", 0u, 0u);
   query.gpu_ok = true;
 
   return true;
@@ -120,11 +121,16 @@ bool lineKeysQueryGpu(LineKeysQueryDetailGpu &query, bool /*async*/)
   // logutil::trace("Worst case key requirement: ", query.max_keys_per_line, '\n');
   // logutil::trace("Occupancy Key size ", sizeof(Key), " GPU Key size: ", kGpuKeySize, '\n');
 
+  gputil::Buffer &lines_out = (query.output_buffer) ? *query.output_buffer : query.lines_out;
   size_t required_size = query.rays.size() / 2 * query.max_keys_per_line * kGpuKeySize;
-  if (query.lines_out.size() < required_size)
+  if (!lines_out.isValid())
+  {
+    lines_out = gputil::Buffer(query.gpu, required_size, gputil::kBfReadWrite);
+  }
+  if (lines_out.size() < required_size)
   {
     // logutil::trace("Required bytes ", required_size, " for ", query.rays.size() / 2u, " lines\n");
-    query.lines_out.resize(required_size);
+    lines_out.resize(required_size);
   }
   required_size = query.rays.size() * sizeof(gputil::float3);
   if (query.line_points.size() < required_size)
@@ -132,6 +138,8 @@ bool lineKeysQueryGpu(LineKeysQueryDetailGpu &query, bool /*async*/)
     // logutil::trace("line_points size: ", required_size, '\n');
     query.line_points.resize(required_size);
   }
+  // A caller supplied output buffer is not ours to report.
+  query.memory_consumer.reportUsage(query.lines_out.actualSize() + query.line_points.actualSize());
 
   // Upload rays. Need to write one at a time due to precision change and size differences.
   glm::vec3 point_f;
@@ -153,9 +161,10 @@ bool lineKeysQueryGpu(LineKeysQueryDetailGpu &query, bool /*async*/)
 
   // Ensure all memory transfers have completed.
   query.queue.insertBarrier();
-  int err = query.line_keys_kernel(global_size, local_size, &query.queue,
+  query.completion_event.release();
+  int err = query.line_keys_kernel(global_size, local_size, query.completion_event, &query.queue,
                                    // Kernel args
-                                   gputil::BufferArg<GpuKey>(query.lines_out), query.max_keys_per_line,
+                                   gputil::BufferArg<GpuKey>(lines_out), query.max_keys_per_line,
                                    gputil::BufferArg<gputil::float3>(query.line_points),
                                    gputil::uint(query.rays.size() / 2), region_dim, float(query.map->resolution()));
 
@@ -164,12 +173,22 @@ bool lineKeysQueryGpu(LineKeysQueryDetailGpu &query, bool /*async*/)
     return false;
   }
 
+  // Ensure the kernel is submitted for asynchronous queries.
+  query.queue.flush();
   query.inflight = true;
   return true;
 }
 
 bool readGpuResults(LineKeysQueryDetailGpu &query)
 {
+  if (query.output_buffer)
+  {
+    // Results remain on GPU.
+    query.number_of_results = 0;
+    query.inflight = false;
+    return true;
+  }
+
   // logutil::trace("Reading results\n");
   // Download results.
   gputil::PinnedBuffer gpu_mem(query.lines_out, gputil::kPinRead);
@@ -252,6 +271,8 @@ LineKeysQueryGpu::LineKeysQueryGpu(unsigned query_flags)
 
 LineKeysQueryGpu::~LineKeysQueryGpu()
 {
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
   auto *d = static_cast<LineKeysQueryDetailGpu *>(imp_);
   if (d && d->gpu_ok)
   {
@@ -302,13 +323,18 @@ bool LineKeysQueryGpu::onExecuteAsync()
 
     if (d->gpu_ok)
     {
-      bool ok = lineKeysQueryGpu(*d, true);
-      if (ok)
+      // Clear existing results as execute() would.
+      resetResults(false);
+      if (!lineKeysQueryGpu(*d, true))
       {
-        // d->queue.flush();
-        // ok = readGpuResults(*d);
+        return false;
       }
-      return ok;
+
+      // Read the results once the kernel completion event fires.
+      return completeAsync([d]() {
+        d->completion_event.wait();
+        return readGpuResults(*d);
+      });
     }
 
     static bool once = false;
@@ -317,9 +343,11 @@ bool LineKeysQueryGpu::onExecuteAsync()
       once = true;
       logutil::warn("GPU unavailable for LineKeysQuery. Failing async call.\n");
     }
+
+    return false;
   }
 
-  return false;
+  return LineKeysQuery::onExecuteAsync();
 }
 
 
@@ -331,25 +359,21 @@ void LineKeysQueryGpu::onReset(bool /*hard_reset*/)
 }
 
 
-bool LineKeysQueryGpu::onWaitAsync(unsigned timeout_ms)
+void LineKeysQueryGpu::setOutputBuffer(gputil::Buffer *buffer)
 {
-  auto *d = static_cast<LineKeysQueryDetailGpu *>(imp_);
-  const auto sleep_interval = std::chrono::milliseconds(0);
-  const auto start_time = std::chrono::system_clock::now();
-  auto timeout = std::chrono::milliseconds(timeout_ms);
-  while (d->inflight)
-  {
-    std::this_thread::sleep_for(sleep_interval);
-    if (timeout_ms != ~0u)
-    {
-      if (std::chrono::system_clock::now() - start_time >= timeout)
-      {
-        break;
-      }
-    }
-  }
+  imp()->output_buffer = buffer;
+}
 
-  return !d->inflight;
+
+gputil::Buffer *LineKeysQueryGpu::outputBuffer() const
+{
+  return imp()->output_buffer;
+}
+
+
+unsigned LineKeysQueryGpu::maxKeysPerLine() const
+{
+  return imp()->max_keys_per_line;
 }
 
 
@@ -12,6 +12,11 @@
 
 #include <glm/fwd.hpp>
 
+namespace gputil
+{
+class Buffer;
+}  // namespace gputil
+
 namespace ohm
 {
 struct LineKeysQueryDetailGpu;
@@ -36,6 +41,9 @@ struct LineKeysQueryDetailGpu;
 /// counts identify how many voxels are present for the current line counting from the associated index.
 /// There should always be at least one voxel per ray for the start/end voxel. More generally, the first voxel
 /// is the ray start voxel and the last voxel is the ray end voxel.
+///
+/// GPU results may be left on GPU for consumption by other kernels by setting an @c outputBuffer() . No results are
+/// then read back to host.
 class ohmgpu_API LineKeysQueryGpu : public LineKeysQuery
 {
 protected:
@@ -58,11 +66,29 @@ public:
   /// Destructor.
   ~LineKeysQueryGpu() override;
 
+  /// Set a GPU buffer to receive the line keys, leaving them on GPU without readback. The buffer holds
+  /// @c maxKeysPerLine() @c GpuKey items for each ray. The first item for each ray holds the ray's key count in each
+  /// of the @c GpuKey::region components and is followed by the keys themselves. The buffer is allocated or enlarged
+  /// as required and must remain valid until cleared or the query is destroyed.
+  ///
+  /// The host results are not populated while an output buffer is set. Use @c wait() to synchronise with the GPU
+  /// results.
+  ///
+  /// @param buffer The buffer to write to or null to read results back to host.
+  void setOutputBuffer(gputil::Buffer *buffer);
+
+  /// Query the buffer set by @c setOutputBuffer() .
+  /// @return The output buffer or null.
+  gputil::Buffer *outputBuffer() const;
+
+  /// Query the per ray stride of the GPU results for the last GPU query. See @c setOutputBuffer() .
+  /// @return The number of @c GpuKey items per ray, including the key count item.
+  unsigned maxKeysPerLine() const;
+
 protected:
   bool onExecute() override;
   bool onExecuteAsync() override;
   void onReset(bool hard_reset) override;
-  bool onWaitAsync(unsigned timeout_ms) override;
 
   /// Internal pimpl data access.
   /// @return Pimpl data pointer.
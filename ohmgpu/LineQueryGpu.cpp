@@ -62,6 +62,8 @@ LineQueryGpu::LineQueryGpu(OccupancyMap &map, const glm::dvec3 &start_point, con
 
 LineQueryGpu::~LineQueryGpu()
 {
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
   LineQueryDetailGpu *d = imp();
   if (d)
   {
@@ -180,6 +182,14 @@ bool LineQueryGpu::onExecute()
 
 bool LineQueryGpu::onExecuteAsync()
 {
+  LineQueryDetailGpu *d = imp();
+
+  if (!(d->query_flags & kQfGpuEvaluate))
+  {
+    return LineQuery::onExecuteAsync();
+  }
+
+  // GPU evaluation is synchronous via the ClearanceProcess.
   return false;
 }
 
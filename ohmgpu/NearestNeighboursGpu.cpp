@@ -0,0 +1,542 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "NearestNeighboursGpu.h"
+
+#include "GpuCache.h"
+#include "GpuLayerCache.h"
+#include "GpuMap.h"
+
+#include "private/GpuProgramRef.h"
+#include "private/NearestNeighboursDetailGpu.h"
+
+#include "gpu/NearestNeighboursResult.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapRegion.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/QueryFlag.h>
+
+#include <gputil/gpuEventList.h>
+#include <gputil/gpuPlatform.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <unordered_map>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "NearestNeighboursResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(nearestNeighbours);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("NearestNeighbours", GpuProgramRef::kSourceString,  // NOLINT
+                            NearestNeighboursCode, NearestNeighboursCode_length);
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("NearestNeighbours", GpuProgramRef::kSourceFile, "NearestNeighbours.cl", 0u);
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+/// Memory offset value marking a missing region. Matches @c NN_NoRegion .
+constexpr uint64_t kNoRegion = ~uint64_t(0u);
+/// Maximum number of query points per kernel invocation. This bounds the second dimension of the kernel grid.
+constexpr size_t kMaxBatchPoints = 4096u;
+/// Initial capacity of the appended results buffer.
+constexpr size_t kInitialResultCapacity = 16 * 1024u;
+
+/// Query parameters shared by all batches.
+struct GpuQueryParams
+{
+  glm::ivec3 region_dim{ 0 };
+  /// Number of regions in each point's region table along each axis.
+  glm::ivec3 region_span{ 0 };
+  /// Number of region table entries per point.
+  size_t region_volume = 0;
+  /// Number of voxels along each axis of the search cube.
+  int cube_dim = 0;
+  unsigned voxel_order = 0;
+  /// @c NN_FlagUnknownAsOccupied and @c NN_FlagNearestResult flags.
+  unsigned flags = 0;
+};
+
+/// Query points and region tables accumulated for a single GPU cache batch.
+struct GpuBatch
+{
+  std::vector<NearestNeighboursPoint> points;
+  /// Region tables for @c points with @c GpuQueryParams::region_volume entries per point.
+  std::vector<uint64_t> region_offsets;
+  /// Index of each batch point in @c NearestNeighboursBatchDetail::near_points .
+  std::vector<size_t> point_indices;
+  /// Cube min voxel key for each batch point.
+  std::vector<Key> min_keys;
+  /// Cache offsets of the regions resolved for this batch.
+  std::unordered_map<glm::i16vec3, uint64_t, MapRegion::Hash> regions;
+  gputil::EventList upload_events;
+  unsigned batch_marker = 0;
+
+  void clear()
+  {
+    points.clear();
+    region_offsets.clear();
+    point_indices.clear();
+    min_keys.clear();
+    regions.clear();
+    upload_events.clear();
+  }
+};
+
+/// A voxel reported for a query point.
+struct PointResult
+{
+  size_t point_index;
+  Key key;
+  double range;
+};
+
+
+/// Load the GPU program and kernel for @p gpu if required.
+/// @return True if the kernel is available.
+bool cacheGpuProgram(NearestNeighboursDetailGpu &d, const gputil::Device &gpu)
+{
+  if (d.program_ref)
+  {
+    return d.kernel.isValid();
+  }
+
+  d.gpu = gpu;
+  d.program_ref = &g_program_ref;
+  if (d.program_ref->addReference(d.gpu))
+  {
+    d.kernel = GPUTIL_MAKE_KERNEL(d.program_ref->program(d.gpu), nearestNeighbours);
+    if (d.kernel.isValid())
+    {
+      d.kernel.calculateOptimalWorkGroupSize();
+      d.points_gpu = gputil::Buffer(d.gpu, kMaxBatchPoints * sizeof(NearestNeighboursPoint), gputil::kBfReadHost);
+      d.region_offsets_gpu = gputil::Buffer(d.gpu, kMaxBatchPoints * sizeof(uint64_t), gputil::kBfReadHost);
+      d.results_gpu =
+        gputil::Buffer(d.gpu, kInitialResultCapacity * sizeof(NearestNeighboursResult), gputil::kBfWriteHost);
+      d.result_count_gpu = gputil::Buffer(d.gpu, sizeof(uint32_t), gputil::kBfReadWriteHost);
+      d.nearest_gpu = gputil::Buffer(d.gpu, 2u * kMaxBatchPoints * sizeof(uint32_t), gputil::kBfReadWriteHost);
+    }
+  }
+
+  return d.kernel.isValid();
+}
+
+
+void releaseGpuProgram(NearestNeighboursDetailGpu &d)
+{
+  d.points_gpu = gputil::Buffer();
+  d.region_offsets_gpu = gputil::Buffer();
+  d.results_gpu = gputil::Buffer();
+  d.result_count_gpu = gputil::Buffer();
+  d.nearest_gpu = gputil::Buffer();
+  d.kernel = gputil::Kernel();
+
+  if (d.program_ref)
+  {
+    d.program_ref->releaseReference();
+    d.program_ref = nullptr;
+  }
+  d.gpu = gputil::Device();
+}
+
+
+/// Add the query point at @p point_index to the @p batch , resolving its region table. Regions are uploaded to the
+/// @p occupancy_cache once per batch.
+/// @return False if the GPU cache cannot hold the point's regions in this batch. The @p batch points are unchanged.
+bool addBatchPoint(const NearestNeighboursDetailGpu &d, GpuLayerCache &occupancy_cache, const GpuQueryParams &params,
+                   size_t point_index, GpuBatch &batch)
+{
+  OccupancyMap &map = *d.map;
+  const glm::dvec3 &near_point = d.near_points[point_index];
+  const Key min_key = map.voxelKey(near_point - glm::dvec3(d.search_radius));
+
+  const size_t table_start = batch.region_offsets.size();
+  batch.region_offsets.resize(table_start + params.region_volume, kNoRegion);
+  for (int z = 0; z < params.region_span.z; ++z)
+  {
+    for (int y = 0; y < params.region_span.y; ++y)
+    {
+      for (int x = 0; x < params.region_span.x; ++x)
+      {
+        const glm::i16vec3 region_key(min_key.regionKey().x + x, min_key.regionKey().y + y,
+                                      min_key.regionKey().z + z);
+        const size_t table_index =
+          table_start + size_t(x + y * params.region_span.x + z * params.region_span.x * params.region_span.y);
+
+        const auto region_iter = batch.regions.find(region_key);
+        if (region_iter != batch.regions.end())
+        {
+          batch.region_offsets[table_index] = region_iter->second;
+          continue;
+        }
+
+        uint64_t mem_offset = kNoRegion;
+        MapChunk *chunk = map.region(region_key, false);
+        if (chunk)
+        {
+          gputil::Event upload_event;
+          GpuLayerCache::CacheStatus status;
+          mem_offset = uint64_t(occupancy_cache.upload(map, region_key, chunk, &upload_event, &status,
+                                                       batch.batch_marker, GpuLayerCache::kSkipDownload));
+          if (status == GpuLayerCache::kCacheFull)
+          {
+            batch.region_offsets.resize(table_start);
+            return false;
+          }
+
+          if (upload_event.isValid())
+          {
+            batch.upload_events.add(upload_event);
+          }
+        }
+
+        batch.regions.emplace(region_key, mem_offset);
+        batch.region_offsets[table_index] = mem_offset;
+      }
+    }
+  }
+
+  const glm::vec3 offset(near_point - map.voxelCentreGlobal(min_key));
+  NearestNeighboursPoint point{};
+  for (int i = 0; i < 3; ++i)
+  {
+    point.offset[i] = offset[i];
+    point.min_voxel[i] = int(min_key.localKey()[i]);
+  }
+
+  batch.points.emplace_back(point);
+  batch.point_indices.emplace_back(point_index);
+  batch.min_keys.emplace_back(min_key);
+  return true;
+}
+
+
+/// Resolve the key for the search cube voxel at @p voxel_index relative to @p min_key .
+Key cubeVoxelKey(const OccupancyMap &map, const Key &min_key, unsigned voxel_index, int cube_dim)
+{
+  Key key = min_key;
+  map.moveKeyAlongAxis(key, 0, int(voxel_index % unsigned(cube_dim)));
+  map.moveKeyAlongAxis(key, 1, int((voxel_index / unsigned(cube_dim)) % unsigned(cube_dim)));
+  map.moveKeyAlongAxis(key, 2, int(voxel_index / unsigned(cube_dim * cube_dim)));
+  return key;
+}
+
+
+/// Evaluate the points in @p batch on GPU, appending to @p results .
+/// @return False on a GPU error.
+bool evaluateBatch(NearestNeighboursDetailGpu &d, GpuCache &gpu_cache, GpuLayerCache &occupancy_cache,
+                   const GpuQueryParams &params, GpuBatch &batch, std::vector<PointResult> &results)
+{
+  if (batch.points.empty())
+  {
+    return true;
+  }
+
+  OccupancyMap &map = *d.map;
+  const auto point_count = unsigned(batch.points.size());
+  d.points_gpu.elementsResize<NearestNeighboursPoint>(point_count);
+  d.points_gpu.write(batch.points.data(), point_count * sizeof(NearestNeighboursPoint));
+  d.region_offsets_gpu.elementsResize<uint64_t>(batch.region_offsets.size());
+  d.region_offsets_gpu.write(batch.region_offsets.data(), batch.region_offsets.size() * sizeof(uint64_t));
+
+  const gputil::int3 region_dim_gpu = { params.region_dim.x, params.region_dim.y, params.region_dim.z };
+  const gputil::int3 region_span_gpu = { params.region_span.x, params.region_span.y, params.region_span.z };
+  const auto cube_volume = size_t(params.cube_dim) * size_t(params.cube_dim) * size_t(params.cube_dim);
+
+  gputil::Dim3 global_size;
+  gputil::Dim3 local_size;
+  d.kernel.calculateGrid(&global_size, &local_size, gputil::Dim3(cube_volume, point_count, 1));
+
+  gputil::Queue &queue = gpu_cache.gpuQueue();
+  gputil::Event kernel_event;
+
+  const auto invoke = [&](unsigned pass, const gputil::EventList &wait, unsigned max_results) {
+    return d.kernel(global_size, local_size, wait, kernel_event, &queue,
+                    // Kernel arguments
+                    gputil::BufferArg<float>(*occupancy_cache.buffer()),
+                    gputil::BufferArg<uint64_t>(d.region_offsets_gpu),
+                    gputil::BufferArg<NearestNeighboursPoint>(d.points_gpu), point_count, region_dim_gpu,
+                    region_span_gpu, params.cube_dim, params.voxel_order, float(map.resolution()), d.search_radius,
+                    map.occupancyThresholdValue(), params.flags, pass,
+                    gputil::BufferArg<NearestNeighboursResult>(d.results_gpu), max_results,
+                    gputil::BufferArg<uint32_t>(d.result_count_gpu), gputil::BufferArg<uint32_t>(d.nearest_gpu));
+  };
+
+  if (params.flags & NN_FlagNearestResult)
+  {
+    // Reduce to the nearest voxel on GPU: first the minimum range, then the voxel at that range.
+    const uint32_t init = ~0u;
+    d.nearest_gpu.elementsResize<uint32_t>(2u * point_count);
+    d.nearest_gpu.fill(&init, sizeof(init));
+
+    if (invoke(NN_PassNearestRange, batch.upload_events, 0u))
+    {
+      return false;
+    }
+    const gputil::EventList range_events({ kernel_event });
+    if (invoke(NN_PassNearestVoxel, range_events, 0u))
+    {
+      return false;
+    }
+
+    std::vector<uint32_t> nearest(2u * point_count);
+    d.nearest_gpu.read(nearest.data(), nearest.size() * sizeof(uint32_t), 0, nullptr, &kernel_event);
+
+    for (size_t i = 0; i < point_count; ++i)
+    {
+      const uint32_t voxel_index = nearest[2u * i + 1u];
+      if (voxel_index == ~0u)
+      {
+        continue;
+      }
+
+      float range_squared = 0;
+      std::memcpy(&range_squared, &nearest[2u * i], sizeof(range_squared));
+      results.emplace_back(PointResult{ batch.point_indices[i],
+                                        cubeVoxelKey(map, batch.min_keys[i], voxel_index, params.cube_dim),
+                                        std::sqrt(range_squared) });
+    }
+  }
+  else
+  {
+    // Run the kernel, resizing and running again if the results buffer overflows.
+    uint32_t result_count = 0;
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+      const uint32_t zero = 0u;
+      d.result_count_gpu.write(&zero, sizeof(zero));
+      const auto max_results = unsigned(d.results_gpu.size() / sizeof(NearestNeighboursResult));
+
+      if (invoke(NN_PassNearestRange, batch.upload_events, max_results))
+      {
+        return false;
+      }
+
+      d.result_count_gpu.read(&result_count, sizeof(result_count), 0, nullptr, &kernel_event);
+      if (result_count <= max_results)
+      {
+        break;
+      }
+
+      d.results_gpu.elementsResize<NearestNeighboursResult>(result_count);
+    }
+
+    std::vector<NearestNeighboursResult> gpu_results(result_count);
+    d.results_gpu.read(gpu_results.data(), gpu_results.size() * sizeof(NearestNeighboursResult), 0, nullptr,
+                       &kernel_event);
+
+    results.reserve(results.size() + gpu_results.size());
+    for (const NearestNeighboursResult &gpu_result : gpu_results)
+    {
+      results.emplace_back(
+        PointResult{ batch.point_indices[gpu_result.point_index],
+                     cubeVoxelKey(map, batch.min_keys[gpu_result.point_index], gpu_result.voxel_index,
+                                  params.cube_dim),
+                     double(gpu_result.range) });
+    }
+  }
+
+  // Lock the regions with the kernel so they are not modified before we complete.
+  occupancy_cache.updateEvents(batch.batch_marker, kernel_event);
+  return true;
+}
+
+
+bool nearestNeighboursGpu(NearestNeighboursDetailGpu &d, GpuCache &gpu_cache, GpuLayerCache &occupancy_cache)
+{
+  OccupancyMap &map = *d.map;
+
+  GpuQueryParams params;
+  params.region_dim = map.regionVoxelDimensions();
+  params.cube_dim = int(std::ceil(2.0 * d.search_radius / map.resolution())) + 1;
+  params.region_volume = 1u;
+  for (int i = 0; i < 3; ++i)
+  {
+    // The cube spans at most this many regions when starting at the last voxel of a region.
+    params.region_span[i] = (params.cube_dim + params.region_dim[i] - 2) / params.region_dim[i] + 1;
+    params.region_volume *= size_t(params.region_span[i]);
+  }
+  params.voxel_order = unsigned(map.layerVoxelOrder(map.layout().occupancyLayer()));
+  params.flags |= (d.query_flags & kQfUnknownAsOccupied) ? NN_FlagUnknownAsOccupied : 0u;
+  params.flags |= (d.query_flags & kQfNearestResult) ? NN_FlagNearestResult : 0u;
+
+  // Evaluate in region order so points sharing regions are likely to share a batch.
+  std::vector<size_t> order(d.near_points.size());
+  std::vector<glm::i16vec3> point_regions(d.near_points.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  for (size_t i = 0; i < d.near_points.size(); ++i)
+  {
+    point_regions[i] = map.regionKey(d.near_points[i] - glm::dvec3(d.search_radius));
+  }
+  std::sort(order.begin(), order.end(), [&point_regions](size_t a, size_t b) {
+    const glm::i16vec3 &ra = point_regions[a];
+    const glm::i16vec3 &rb = point_regions[b];
+    return (ra.z != rb.z) ? ra.z < rb.z : ((ra.y != rb.y) ? ra.y < rb.y : ra.x < rb.x);
+  });
+
+  std::vector<PointResult> results;
+  GpuBatch batch;
+  batch.batch_marker = occupancy_cache.beginBatch();
+  for (const size_t point_index : order)
+  {
+    if (batch.points.size() >= kMaxBatchPoints || !addBatchPoint(d, occupancy_cache, params, point_index, batch))
+    {
+      // Batch limit reached or the cache is full. Evaluate the batch so far and start a new one.
+      const bool retry = !batch.points.empty();
+      if (!evaluateBatch(d, gpu_cache, occupancy_cache, params, batch, results))
+      {
+        return false;
+      }
+      batch.clear();
+      batch.batch_marker = occupancy_cache.beginBatch();
+
+      if (!retry || !addBatchPoint(d, occupancy_cache, params, point_index, batch))
+      {
+        std::cerr << "NearestNeighboursGpu: GPU cache too small for the search radius.\n" << std::flush;
+        return false;
+      }
+    }
+  }
+
+  if (!evaluateBatch(d, gpu_cache, occupancy_cache, params, batch, results))
+  {
+    return false;
+  }
+
+  // Lay out the results in the original query point order.
+  const size_t point_count = d.near_points.size();
+  d.result_indices.resize(point_count);
+  d.result_counts.assign(point_count, 0u);
+  for (const PointResult &result : results)
+  {
+    ++d.result_counts[result.point_index];
+  }
+
+  size_t result_index = d.intersected_voxels.size();
+  for (size_t i = 0; i < point_count; ++i)
+  {
+    d.result_indices[i] = result_index;
+    result_index += d.result_counts[i];
+  }
+  d.intersected_voxels.resize(result_index);
+  d.ranges.resize(result_index);
+
+  std::vector<size_t> write_indices(d.result_indices);
+  for (const PointResult &result : results)
+  {
+    const size_t dst = write_indices[result.point_index]++;
+    d.intersected_voxels[dst] = result.key;
+    d.ranges[dst] = result.range;
+  }
+
+  d.number_of_results = point_count;
+
+  return true;
+}
+}  // namespace
+
+
+NearestNeighboursGpu::NearestNeighboursGpu(NearestNeighboursDetailGpu *detail)
+  : NearestNeighboursBatch(detail)
+{}
+
+
+NearestNeighboursGpu::NearestNeighboursGpu(OccupancyMap &map, float search_radius, unsigned query_flags)
+  : NearestNeighboursGpu(query_flags)
+{
+  setMap(&map);
+  setSearchRadius(search_radius);
+}
+
+
+NearestNeighboursGpu::NearestNeighboursGpu(unsigned query_flags)
+  : NearestNeighboursGpu(new NearestNeighboursDetailGpu)
+{
+  setQueryFlags(query_flags);
+}
+
+
+NearestNeighboursGpu::~NearestNeighboursGpu()
+{
+  // Ensure any asynchronous query completes before the detail is released.
+  wait();
+  NearestNeighboursDetailGpu *d = imp();
+  if (d)
+  {
+    releaseGpuProgram(*d);
+    delete d;
+  }
+  // Clear pointer for base class.
+  imp_ = nullptr;
+}
+
+
+bool NearestNeighboursGpu::onExecute()
+{
+  NearestNeighboursDetailGpu *d = imp();
+
+  if (!d->map)
+  {
+    return false;
+  }
+
+  if (!(d->query_flags & kQfGpuEvaluate) || d->map->layout().occupancyLayer() < 0)
+  {
+    return NearestNeighboursBatch::onExecute();
+  }
+
+  GpuCache *gpu_cache = initialiseGpuCache(*d->map, GpuCache::kDefaultTargetMemSize, gpumap::kGpuAllowMappedBuffers);
+  GpuLayerCache *occupancy_cache = (gpu_cache) ? gpu_cache->layerCache(kGcIdOccupancy) : nullptr;
+  if (!occupancy_cache || occupancy_cache->packedOccupancy() || !cacheGpuProgram(*d, gpu_cache->gpu()))
+  {
+    // GPU evaluation is not available. Fall back to CPU.
+    return NearestNeighboursBatch::onExecute();
+  }
+
+  return nearestNeighboursGpu(*d, *gpu_cache, *occupancy_cache);
+}
+
+
+bool NearestNeighboursGpu::onExecuteAsync()
+{
+  NearestNeighboursDetailGpu *d = imp();
+
+  if (!(d->query_flags & kQfGpuEvaluate))
+  {
+    return NearestNeighboursBatch::onExecuteAsync();
+  }
+
+  // GPU evaluation is synchronous.
+  return false;
+}
+
+
+NearestNeighboursDetailGpu *NearestNeighboursGpu::imp()
+{
+  return static_cast<NearestNeighboursDetailGpu *>(imp_);
+}
+
+
+const NearestNeighboursDetailGpu *NearestNeighboursGpu::imp() const
+{
+  return static_cast<const NearestNeighboursDetailGpu *>(imp_);
+}
+}  // namespace ohm
@@ -0,0 +1,71 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_NEARESTNEIGHBOURSGPU_H
+#define OHMGPU_NEARESTNEIGHBOURSGPU_H
+
+#include "OhmGpuConfig.h"
+
+#include <ohm/NearestNeighboursBatch.h>
+
+namespace ohm
+{
+struct NearestNeighboursDetailGpu;
+
+/// GPU implementation of the @c NearestNeighboursBatch query.
+///
+/// With @c kQfGpuEvaluate set, the query points are evaluated on GPU against the occupancy voxels held in (or uploaded
+/// to) the map's @c GpuLayerCache . Otherwise the CPU @c NearestNeighboursBatch implementation is used. The results
+/// match the CPU implementation, including the @c kQfNearestResult and @c kQfUnknownAsOccupied behaviour, although
+/// the order of voxels within each point's results may differ. Nearest result ties are resolved in favour of the
+/// voxel with the lowest z, then y, then x coordinate.
+///
+/// Each query point searches the cube of voxels bounding its search sphere with one GPU thread per voxel. The regions
+/// overlapping the cube of each point are uploaded once per batch. When the GPU cache cannot hold the regions for all
+/// query points, the points resolved so far are evaluated and a new batch is started. With @c kQfNearestResult the
+/// reduction to a single voxel per point is made on GPU, so only one result per point is downloaded.
+///
+/// The CPU implementation is used when the GPU program is not available or the GPU cache uses packed occupancy, which
+/// is not supported. GPU evaluation is synchronous: @c executeAsync() is not supported with @c kQfGpuEvaluate .
+class ohmgpu_API NearestNeighboursGpu : public NearestNeighboursBatch
+{
+public:
+  /// Default flags to execute this query with.
+  static const unsigned kDefaultFlags = kQfGpuEvaluate;
+
+protected:
+  /// Constructor used for inherited objects. This supports deriving @p NearestNeighboursDetailGpu into
+  /// more specialised forms.
+  /// @param detail pimple style data structure.
+  explicit NearestNeighboursGpu(NearestNeighboursDetailGpu *detail);
+
+public:
+  /// Construct a new query using the given parameters.
+  /// @param map The map to perform the query on.
+  /// @param search_radius Defines the search radius around each query point.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag .
+  NearestNeighboursGpu(OccupancyMap &map, float search_radius, unsigned query_flags = kDefaultFlags);
+
+  /// Construct a new query using the given parameters.
+  /// @param query_flags Flags controlling the query behaviour. See @c QueryFlag .
+  explicit NearestNeighboursGpu(unsigned query_flags = kDefaultFlags);
+
+  /// Destructor.
+  ~NearestNeighboursGpu() override;
+
+protected:
+  bool onExecute() override;
+  bool onExecuteAsync() override;
+
+  /// Internal pimpl data access.
+  /// @return Pimpl data pointer.
+  NearestNeighboursDetailGpu *imp();
+  /// Internal pimpl data access.
+  /// @return Pimpl data pointer.
+  const NearestNeighboursDetailGpu *imp() const;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_NEARESTNEIGHBOURSGPU_H
@@ -5,6 +5,7 @@
 // Author: Kazys Stepanas
 #include "OhmGpu.h"
 
+#include "private/GpuProgramRef.h"
 
 #include <gputil/gpuDevice.h>
 
@@ -239,6 +240,17 @@ gputil::Device &gpuDevice()
 }
 
 
+unsigned warmUpGpuPrograms()
+{
+  gputil::Device &gpu = gpuDevice();
+  if (!gpu.isValid())
+  {
+    return 0;
+  }
+  return GpuProgramRef::warmUp(gpu);
+}
+
+
 unsigned gpuArgsInfo(const char **args_info, int *arg_type, unsigned max_pairs)
 {
   // clang-format off
@@ -255,6 +267,7 @@ unsigned gpuArgsInfo(const char **args_info, int *arg_type, unsigned max_pairs)
       { "accel", "Select the OpenCL accelerator type [any,cpu,gpu] (gpu).", 1 },
       { "clver", "Sets the OpenCL runtime version. Selected device must support target OpenCL version. Format via the regex /[1-9][0-9]*(.[1-9][0-9]*)?/.", 1 },
       { "device", "OpenCL device name must contain the given string (case insensitive).", 1 },
+      { "gpu-cache", "Directory in which to cache compiled OpenCL programs. Overrides GPUTIL_PROGRAM_CACHE.", 1 },
       { "gpu-debug", "Compile OpenCL GPU code for full debugging.", 0 },
       { "platform", "OpenCL platform name must contain the given string (case insensitive).", 1 },
       { "vendor", "OpenCL vendor name must contain the given string (case insensitive).", 1 },
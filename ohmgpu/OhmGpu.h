@@ -32,6 +32,8 @@ enum AccelType : unsigned
 /// - --device=<hint> : device name hint. Partial, lower case match is enough.
 /// - --clver=<version> : Minimum OpenCL version string; e.g., "1.2", "2.0" "2".
 /// - --gpu-debug : compile GPU code for debugging (Intel OpenCL)
+/// - --gpu-cache=<dir> : cache compiled GPU programs in the given directory. See
+///   @c gputil::Device::setProgramCacheDir() .
 ///
 /// @param argc Number of arguments in @p argv.
 /// @param argv Command line arguments.
@@ -65,6 +67,15 @@ int ohmgpu_API configureGpu(unsigned accel = kGpuAccel, const char *device_name
 /// @return A reference to the GPU device to use.
 gputil::Device ohmgpu_API &gpuDevice();
 
+/// Build all of the library's GPU programs for the @c gpuDevice() without retaining them.
+///
+/// This supports populating the GPU program binary cache ahead of time - see
+/// @c gputil::Device::setProgramCacheDir() - so that later GPU map construction loads the cached binaries instead of
+/// compiling. The GPU must be configured first. This has no effect for CUDA.
+///
+/// @return The number of programs which failed to build.
+unsigned ohmgpu_API warmUpGpuPrograms();
+
 /// Provides information about the available command line options which control GPU behaviour.
 ///
 /// This populates @p argsInfo with an array of static string pointers arranges in pairs. The pairs
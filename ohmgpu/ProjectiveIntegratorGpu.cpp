@@ -0,0 +1,292 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ProjectiveIntegratorGpu.h"
+
+#include "GpuCache.h"
+#include "GpuLayerCache.h"
+#include "GpuMap.h"
+
+#include "private/GpuMapDetail.h"
+#include "private/GpuProgramRef.h"
+
+#include "gpu/ProjectiveIntegrateParams.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelOccupancy.h>
+
+#include <gputil/gpuEventList.h>
+#include <gputil/gpuPlatform.h>
+
+#include <logutil/Logger.h>
+
+#include <algorithm>
+#include <limits>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "ProjectiveIntegrateResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(projectiveIntegrate);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("ProjectiveIntegrate", GpuProgramRef::kSourceString,  // NOLINT
+                            ProjectiveIntegrateCode, ProjectiveIntegrateCode_length);
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("ProjectiveIntegrate", GpuProgramRef::kSourceFile, "ProjectiveIntegrate.cl", 0u);
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+}  // namespace
+
+ProjectiveIntegratorGpu::ProjectiveIntegratorGpu(gputil::Device &gpu)
+  : gpu_(gpu)
+{
+  gpu_params_ = gputil::Buffer(gpu, sizeof(ProjectiveIntegrateParams), gputil::kBfReadHost);
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  gpu_regions_ = gputil::Buffer(gpu, 64 * sizeof(ProjectiveIntegrateRegion), gputil::kBfReadHost);
+  gpu_depth_ = gputil::Buffer(gpu, sizeof(float), gputil::kBfReadHost);
+  gpu_placeholder_ = gputil::Buffer(gpu, sizeof(VoxelTsdf), gputil::kBfReadWrite);
+}
+
+
+ProjectiveIntegratorGpu::~ProjectiveIntegratorGpu()
+{
+  if (completion_event_.isValid())
+  {
+    completion_event_.wait();
+  }
+  completion_event_ = gputil::Event();
+  gpu_params_ = gputil::Buffer();
+  gpu_regions_ = gputil::Buffer();
+  gpu_depth_ = gputil::Buffer();
+  gpu_placeholder_ = gputil::Buffer();
+  releaseGpuProgram();
+  gpu_ = gputil::Device();
+}
+
+
+bool ProjectiveIntegratorGpu::integrate(OccupancyMap &map, const float *depth, const glm::dmat4 &camera_to_map)
+{
+  region_keys_.clear();
+
+  cacheGpuProgram(false);
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int tsdf_layer = map.layout().layerIndex(default_layer::tsdfLayerName());
+  if (!integrate_kernel_.isValid() || !depth || (occupancy_layer < 0 && tsdf_layer < 0))
+  {
+    return false;
+  }
+
+  GpuCache *gpu_cache = initialiseGpuCache(map, GpuCache::kDefaultTargetMemSize, gpumap::kGpuAllowMappedBuffers);
+  GpuLayerCache *occupancy_cache = (occupancy_layer >= 0) ? gpu_cache->layerCache(kGcIdOccupancy) : nullptr;
+  GpuLayerCache *tsdf_cache = (tsdf_layer >= 0) ? gpu_cache->layerCache(kGcIdTsdf) : nullptr;
+  if (occupancy_cache && occupancy_cache->packedOccupancy())
+  {
+    logutil::error("ProjectiveIntegratorGpu: packed occupancy GPU cache not supported.\n");
+    return false;
+  }
+
+  if (!occupancy_cache && !tsdf_cache)
+  {
+    return false;
+  }
+
+  // Margin as for ProjectiveIntegrator.
+  double margin = 0.5 * map.resolution();
+  if (tsdf_cache)
+  {
+    margin = std::max(margin, double(tsdf_options_.default_truncation_distance));
+  }
+
+  if (!projectiveRegions(map, camera_, depth, camera_to_map, margin, region_keys_))
+  {
+    return true;
+  }
+
+  // Wait for the previous update before overwriting its buffers.
+  if (completion_event_.isValid())
+  {
+    completion_event_.wait();
+  }
+
+  // Upload the regions, creating them as required.
+  const glm::dvec3 camera_position(camera_to_map[3]);
+  std::vector<ProjectiveIntegrateRegion> regions(region_keys_.size());
+  gputil::EventList upload_events;
+  const unsigned occupancy_batch_marker = (occupancy_cache) ? occupancy_cache->beginBatch() : 0u;
+  const unsigned tsdf_batch_marker = (tsdf_cache) ? tsdf_cache->beginBatch() : 0u;
+  for (size_t i = 0; i < region_keys_.size(); ++i)
+  {
+    ProjectiveIntegrateRegion &region = regions[i];
+    const glm::dvec3 region_min = map.regionSpatialMin(region_keys_[i]) - camera_position;
+    for (int a = 0; a < 3; ++a)
+    {
+      region.region_min[a] = float(region_min[a]);
+    }
+    region.occupancy_offset = region.tsdf_offset = 0u;
+
+    GpuLayerCache *caches[2] = { occupancy_cache, tsdf_cache };
+    const unsigned batch_markers[2] = { occupancy_batch_marker, tsdf_batch_marker };
+    for (int c = 0; c < 2; ++c)
+    {
+      if (!caches[c])
+      {
+        continue;
+      }
+
+      gputil::Event upload_event;
+      GpuLayerCache::CacheStatus status;
+      MapChunk *chunk = nullptr;
+      const size_t mem_offset = caches[c]->upload(map, region_keys_[i], chunk, &upload_event, &status,
+                                                  batch_markers[c], GpuLayerCache::kAllowRegionCreate);
+      if (status == GpuLayerCache::kCacheFull)
+      {
+        logutil::error("ProjectiveIntegratorGpu: GPU cache full. Unable to integrate.\n");
+        region_keys_.clear();
+        return false;
+      }
+
+      if (upload_event.isValid())
+      {
+        upload_events.add(upload_event);
+      }
+
+      if (c == 0)
+      {
+        region.occupancy_offset = unsigned(mem_offset / sizeof(float));
+      }
+      else
+      {
+        region.tsdf_offset = unsigned(mem_offset / sizeof(VoxelTsdf));
+      }
+    }
+  }
+
+  // Resolve the kernel parameters.
+  ProjectiveIntegrateParams params{};
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      // Transpose of the camera to map rotation.
+      params.rotation[r * 3 + c] = float(camera_to_map[r][c]);
+    }
+    params.region_dimensions[r] = region_dim[r];
+  }
+  params.intrinsics[0] = float(camera_.fx);
+  params.intrinsics[1] = float(camera_.fy);
+  params.intrinsics[2] = float(camera_.cx);
+  params.intrinsics[3] = float(camera_.cy);
+  params.resolution = float(map.resolution());
+  params.min_depth = float(camera_.min_depth);
+  params.max_depth = float(camera_.max_depth);
+  params.hit_value = map.hitValue();
+  params.miss_value = map.missValue();
+  params.voxel_value_min = map.minVoxelValue();
+  params.voxel_value_max = map.maxVoxelValue();
+  params.saturation_min = map.saturateAtMinValue() ? map.minVoxelValue() : std::numeric_limits<float>::lowest();
+  params.saturation_max = map.saturateAtMaxValue() ? map.maxVoxelValue() : std::numeric_limits<float>::max();
+  params.truncation_distance = tsdf_options_.default_truncation_distance;
+  params.max_weight = tsdf_options_.max_weight;
+  params.dropoff_epsilon = tsdf_options_.dropoff_epsilon;
+  params.sparsity_compensation_factor = tsdf_options_.sparsity_compensation_factor;
+  params.occupancy_voxel_order = (occupancy_cache) ? unsigned(map.layerVoxelOrder(occupancy_layer)) : 0u;
+  params.tsdf_voxel_order = (tsdf_cache) ? unsigned(map.layerVoxelOrder(tsdf_layer)) : 0u;
+  params.flags = ((occupancy_cache) ? PI_FlagOccupancy : 0u) | ((tsdf_cache) ? PI_FlagTsdf : 0u);
+  params.width = camera_.width;
+  params.height = camera_.height;
+
+  const size_t pixel_count = size_t(camera_.width) * size_t(camera_.height);
+  gpu_params_.write(&params, sizeof(params));
+  gpu_regions_.elementsResize<ProjectiveIntegrateRegion>(regions.size());
+  gpu_regions_.write(regions.data(), regions.size() * sizeof(*regions.data()));
+  gpu_depth_.elementsResize<float>(pixel_count);
+  gpu_depth_.write(depth, pixel_count * sizeof(*depth));
+
+  const size_t region_volume = size_t(region_dim.x) * size_t(region_dim.y) * size_t(region_dim.z);
+  gputil::Dim3 global_size;
+  gputil::Dim3 local_size;
+  integrate_kernel_.calculateGrid(&global_size, &local_size, gputil::Dim3(regions.size() * region_volume, 1, 1));
+
+  gputil::Queue &queue = gpu_cache->gpuQueue();
+  gputil::Event kernel_event;
+  gputil::Buffer &occupancy_buffer = (occupancy_cache) ? *occupancy_cache->buffer() : gpu_placeholder_;
+  gputil::Buffer &tsdf_buffer = (tsdf_cache) ? *tsdf_cache->buffer() : gpu_placeholder_;
+  const int err = integrate_kernel_(global_size, local_size, upload_events, kernel_event, &queue,
+                                    // Kernel arguments
+                                    gputil::BufferArg<float>(occupancy_buffer),
+                                    gputil::BufferArg<VoxelTsdf>(tsdf_buffer),
+                                    gputil::BufferArg<ProjectiveIntegrateRegion>(gpu_regions_),
+                                    unsigned(regions.size()), gputil::BufferArg<ProjectiveIntegrateParams>(gpu_params_),
+                                    gputil::BufferArg<float>(gpu_depth_));
+  if (err)
+  {
+    return false;
+  }
+
+  // Hold the regions in the caches until the kernel completes.
+  if (occupancy_cache)
+  {
+    occupancy_cache->updateEvents(occupancy_batch_marker, kernel_event);
+  }
+  if (tsdf_cache)
+  {
+    tsdf_cache->updateEvents(tsdf_batch_marker, kernel_event);
+  }
+
+  completion_event_ = kernel_event;
+  queue.flush();
+  return true;
+}
+
+
+void ProjectiveIntegratorGpu::cacheGpuProgram(bool force)
+{
+  if (!force && program_ref_ != nullptr)
+  {
+    // Already loaded.
+    return;
+  }
+
+  releaseGpuProgram();
+
+  program_ref_ = &g_program_ref;
+  if (program_ref_->addReference(gpu_))
+  {
+    integrate_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), projectiveIntegrate);
+    if (!integrate_kernel_.isValid())
+    {
+      releaseGpuProgram();
+    }
+    else
+    {
+      integrate_kernel_.calculateOptimalWorkGroupSize();
+    }
+  }
+}
+
+
+void ProjectiveIntegratorGpu::releaseGpuProgram()
+{
+  integrate_kernel_ = gputil::Kernel();
+
+  if (program_ref_)
+  {
+    program_ref_->releaseReference();
+    program_ref_ = nullptr;
+  }
+}
+}  // namespace ohm
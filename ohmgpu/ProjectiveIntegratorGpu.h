@@ -0,0 +1,101 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_PROJECTIVEINTEGRATORGPU_H
+#define OHMGPU_PROJECTIVEINTEGRATORGPU_H
+
+#include "OhmGpuConfig.h"
+
+#include <ohm/ProjectiveIntegrator.h>
+
+#include <glm/glm.hpp>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuEvent.h>
+#include <gputil/gpuKernel.h>
+
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+class GpuProgramRef;
+
+/// GPU implementation of the @c ProjectiveIntegrator : integrates depth images by projecting voxels into the image.
+///
+/// Regions are selected on CPU with @c projectiveRegions() then uploaded to the map's occupancy and TSDF
+/// @c GpuLayerCache , creating them as required. One GPU thread updates each voxel of the selected regions, following
+/// the same update rules as the @c ProjectiveIntegrator . Unlike the CPU implementation, every selected region is
+/// created, whether or not any of its voxels are updated.
+///
+/// The layer caches are shared with any @c GpuMap for the same map, so updates are visible to that @c GpuMap and are
+/// synchronised back to the map by @c GpuMap::syncVoxels() or @c GpuCache::syncToMainMemory() . Packed occupancy
+/// caches are not supported.
+class ohmgpu_API ProjectiveIntegratorGpu
+{
+public:
+  /// Constructor.
+  /// @param gpu The GPU device to use.
+  explicit ProjectiveIntegratorGpu(gputil::Device &gpu);
+  /// Destructor.
+  ~ProjectiveIntegratorGpu();
+
+  ProjectiveIntegratorGpu(const ProjectiveIntegratorGpu &) = delete;
+  ProjectiveIntegratorGpu &operator=(const ProjectiveIntegratorGpu &) = delete;
+
+  /// Set the camera model.
+  /// @param camera The camera model.
+  inline void setCamera(const DepthCamera &camera) { camera_ = camera; }
+  /// Query the camera model.
+  /// @return The camera model.
+  inline const DepthCamera &camera() const { return camera_; }
+
+  /// Set the TSDF update options. Only used when the map has a @c VoxelTsdf layer.
+  /// @param options The TSDF options.
+  inline void setTsdfOptions(const TsdfOptions &options) { tsdf_options_ = options; }
+  /// Query the TSDF update options.
+  /// @return The TSDF options.
+  inline const TsdfOptions &tsdfOptions() const { return tsdf_options_; }
+
+  /// Integrate a depth image into @p map . The call returns once the update has been queued.
+  /// @param map The map to update.
+  /// @param depth The depth image as for @c ProjectiveIntegrator::integrate() .
+  /// @param camera_to_map The camera pose in the map frame.
+  /// @return True on success, false if the GPU program is unavailable, the map has no layers to update or the GPU
+  ///   cache cannot hold the regions to update.
+  bool integrate(OccupancyMap &map, const float *depth, const glm::dmat4 &camera_to_map);
+
+  /// Access the event marking completion of the last @c integrate() .
+  /// @return The completion event.
+  inline const gputil::Event &completionEvent() const { return completion_event_; }
+
+  /// Query the number of regions updated by the last @c integrate() call.
+  /// @return The region count.
+  inline size_t regionCount() const { return region_keys_.size(); }
+
+private:
+  void cacheGpuProgram(bool force);
+  void releaseGpuProgram();
+
+  gputil::Device gpu_;
+  gputil::Kernel integrate_kernel_;
+  GpuProgramRef *program_ref_ = nullptr;
+  /// Camera and map parameters: a single @c ProjectiveIntegrateParams .
+  gputil::Buffer gpu_params_;
+  /// The @c ProjectiveIntegrateRegion list.
+  gputil::Buffer gpu_regions_;
+  /// The depth image.
+  gputil::Buffer gpu_depth_;
+  /// Placeholder buffer bound for a layer which is not present.
+  gputil::Buffer gpu_placeholder_;
+  gputil::Event completion_event_;
+  DepthCamera camera_;
+  TsdfOptions tsdf_options_;
+  std::vector<glm::i16vec3> region_keys_;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_PROJECTIVEINTEGRATORGPU_H
@@ -0,0 +1,305 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RangeImageGpu.h"
+
+#include "GpuCache.h"
+#include "GpuLayerCache.h"
+#include "GpuMap.h"
+
+#include "private/GpuProgramRef.h"
+
+#include "gpu/RangeImageParams.h"
+
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RegionStatistics.h>
+
+#include <gputil/gpuEventList.h>
+#include <gputil/gpuPlatform.h>
+
+#include <logutil/Logger.h>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "RangeImageResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(rangeImage);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+// Out of class definitions for ODR use under C++14.
+constexpr size_t RangeImageGpu::kMaxGridRegions;
+
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("RangeImage", GpuProgramRef::kSourceString,  // NOLINT
+                            RangeImageCode, RangeImageCode_length);
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("RangeImage", GpuProgramRef::kSourceFile, "RangeImage.cl", 0u);
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+/// Squared distance from @p point to the box [@p box_min , @p box_max ].
+double boxDistanceSquared(const glm::dvec3 &point, const glm::dvec3 &box_min, const glm::dvec3 &box_max)
+{
+  const glm::dvec3 separation = glm::max(box_min - point, glm::max(glm::dvec3(0.0), point - box_max));
+  return glm::dot(separation, separation);
+}
+}  // namespace
+
+RangeImageGpu::RangeImageGpu(gputil::Device &gpu)
+  : gpu_(gpu)
+{
+  gpu_params_ = gputil::Buffer(gpu, sizeof(RangeImageParams), gputil::kBfReadHost);
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  gpu_regions_ = gputil::Buffer(gpu, 64 * sizeof(RangeImageRegion), gputil::kBfReadHost);
+  gpu_ranges_ = gputil::Buffer(gpu, sizeof(float), gputil::kBfWriteHost);
+}
+
+
+RangeImageGpu::~RangeImageGpu()
+{
+  if (completion_event_.isValid())
+  {
+    completion_event_.wait();
+  }
+  completion_event_ = gputil::Event();
+  gpu_params_ = gputil::Buffer();
+  gpu_regions_ = gputil::Buffer();
+  gpu_ranges_ = gputil::Buffer();
+  releaseGpuProgram();
+  gpu_ = gputil::Device();
+}
+
+
+bool RangeImageGpu::render(OccupancyMap &map, const glm::dmat4 &sensor_to_map, gputil::Buffer *output)
+{
+  ranges_.clear();
+  grid_region_count_ = occupied_region_count_ = 0;
+
+  cacheGpuProgram(false);
+  if (!range_kernel_.isValid() || sensor_.width == 0 || sensor_.height == 0 || map.layout().occupancyLayer() < 0)
+  {
+    return false;
+  }
+
+  GpuCache *gpu_cache = initialiseGpuCache(map, GpuCache::kDefaultTargetMemSize, gpumap::kGpuAllowMappedBuffers);
+  GpuLayerCache *occupancy_cache = gpu_cache->layerCache(kGcIdOccupancy);
+  if (occupancy_cache->packedOccupancy())
+  {
+    logutil::error("RangeImageGpu: packed occupancy GPU cache not supported.\n");
+    return false;
+  }
+
+  // Resolve the region grid covering the sensor range.
+  const glm::dvec3 sensor_position(sensor_to_map[3]);
+  const glm::dvec3 range_extents(sensor_.max_range);
+  const Key min_key = map.voxelKey(sensor_position - range_extents);
+  const Key max_key = map.voxelKey(sensor_position + range_extents);
+  if (min_key.isNull() || max_key.isNull())
+  {
+    return false;
+  }
+
+  const glm::ivec3 grid_min(min_key.regionKey());
+  const glm::ivec3 grid_dim = glm::ivec3(max_key.regionKey()) - grid_min + glm::ivec3(1);
+  grid_region_count_ = size_t(grid_dim.x) * size_t(grid_dim.y) * size_t(grid_dim.z);
+  if (grid_region_count_ > kMaxGridRegions)
+  {
+    logutil::error("RangeImageGpu: sensor range spans too many regions: ", grid_region_count_, "\n");
+    return false;
+  }
+
+  // Build the grid, uploading the regions with occupied voxels in range.
+  const double range_squared = sensor_.max_range * sensor_.max_range;
+  const glm::dvec3 region_size = map.regionSpatialResolution();
+  RangeImageRegion empty_region{};
+  empty_region.occupied_min[0] = 1u;
+  std::vector<RangeImageRegion> grid(grid_region_count_, empty_region);
+  std::vector<gputil::Event> upload_events;
+  const unsigned batch_marker = occupancy_cache->beginBatch();
+  glm::ivec3 cell;
+  for (cell.z = 0; cell.z < grid_dim.z; ++cell.z)
+  {
+    for (cell.y = 0; cell.y < grid_dim.y; ++cell.y)
+    {
+      for (cell.x = 0; cell.x < grid_dim.x; ++cell.x)
+      {
+        const glm::i16vec3 region_key(grid_min + cell);
+        const glm::dvec3 region_min = map.regionSpatialMin(region_key);
+        if (boxDistanceSquared(sensor_position, region_min, region_min + region_size) > range_squared)
+        {
+          continue;
+        }
+
+        MapChunk *chunk = map.region(region_key);
+        const RegionStatistics *statistics = (chunk) ? updateRegionStatistics(*chunk) : nullptr;
+        if (!statistics || !statistics->occupied())
+        {
+          continue;
+        }
+
+        gputil::Event upload_event;
+        size_t mem_offset = 0;
+        if (!occupancy_cache->lookup(map, region_key, &mem_offset, &upload_event))
+        {
+          GpuLayerCache::CacheStatus status;
+          mem_offset = occupancy_cache->upload(map, region_key, chunk, &upload_event, &status, batch_marker,
+                                               GpuLayerCache::kSkipDownload);
+          if (status == GpuLayerCache::kCacheFull)
+          {
+            logutil::error("RangeImageGpu: GPU cache full. Unable to render.\n");
+            return false;
+          }
+        }
+
+        if (upload_event.isValid())
+        {
+          upload_events.emplace_back(upload_event);
+        }
+
+        RangeImageRegion &region = grid[cell.x + grid_dim.x * (cell.y + grid_dim.y * cell.z)];
+        region.voxel_offset = unsigned(mem_offset / sizeof(float));
+        for (int i = 0; i < 3; ++i)
+        {
+          region.occupied_min[i] = uint8_t(statistics->min_occupied[i]);
+          region.occupied_max[i] = uint8_t(statistics->max_occupied[i]);
+        }
+        ++occupied_region_count_;
+      }
+    }
+  }
+
+  // Resolve the kernel parameters relative to the grid origin.
+  RangeImageParams params{};
+  const glm::dvec3 grid_origin = map.regionSpatialMin(glm::i16vec3(grid_min));
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      params.rotation[r * 3 + c] = float(sensor_to_map[c][r]);
+    }
+    params.origin[r] = float(sensor_position[r] - grid_origin[r]);
+    params.region_size[r] = float(region_size[r]);
+    params.region_dimensions[r] = region_dim[r];
+    params.grid_dimensions[r] = grid_dim[r];
+  }
+  if (sensor_.model == RangeSensorModel::kSpherical)
+  {
+    params.intrinsics[0] = float(sensor_.min_azimuth);
+    params.intrinsics[1] = float((sensor_.max_azimuth - sensor_.min_azimuth) / sensor_.width);
+    params.intrinsics[2] = float(sensor_.max_elevation);
+    params.intrinsics[3] = float((sensor_.max_elevation - sensor_.min_elevation) / sensor_.height);
+  }
+  else
+  {
+    params.intrinsics[0] = float(sensor_.fx);
+    params.intrinsics[1] = float(sensor_.fy);
+    params.intrinsics[2] = float(sensor_.cx);
+    params.intrinsics[3] = float(sensor_.cy);
+  }
+  params.resolution = float(map.resolution());
+  params.occupied_threshold = map.occupancyThresholdValue();
+  params.min_range = float(sensor_.min_range);
+  params.max_range = float(sensor_.max_range);
+  params.voxel_order = unsigned(map.layerVoxelOrder(map.layout().occupancyLayer()));
+  params.model = int(sensor_.model);
+  params.flags = (sensor_.depth) ? RI_FlagDepth : 0u;
+  params.width = sensor_.width;
+  params.height = sensor_.height;
+
+  gpu_params_.write(&params, sizeof(params));
+  gpu_regions_.elementsResize<RangeImageRegion>(grid.size());
+  gpu_regions_.write(grid.data(), grid.size() * sizeof(*grid.data()));
+
+  const size_t pixel_count = size_t(sensor_.width) * size_t(sensor_.height);
+  gputil::Buffer &ranges_gpu = (output) ? *output : gpu_ranges_;
+  if (!ranges_gpu.isValid())
+  {
+    ranges_gpu = gputil::Buffer(gpu_, sizeof(float) * pixel_count, gputil::kBfReadWrite);
+  }
+  ranges_gpu.elementsResize<float>(pixel_count);
+
+  gputil::Dim3 global_size;
+  gputil::Dim3 local_size;
+  range_kernel_.calculateGrid(&global_size, &local_size, gputil::Dim3(sensor_.width, sensor_.height, 1));
+
+  gputil::Queue &queue = gpu_cache->gpuQueue();
+  gputil::Event kernel_event;
+  const int err = range_kernel_(global_size, local_size, gputil::EventList(upload_events.data(), upload_events.size()),
+                                kernel_event, &queue,
+                                // Kernel arguments
+                                gputil::BufferArg<float>(*occupancy_cache->buffer()),
+                                gputil::BufferArg<RangeImageRegion>(gpu_regions_),
+                                gputil::BufferArg<RangeImageParams>(gpu_params_), gputil::BufferArg<float>(ranges_gpu));
+  if (err)
+  {
+    return false;
+  }
+
+  // Hold the regions in the cache until the kernel completes.
+  occupancy_cache->updateEvents(batch_marker, kernel_event);
+
+  if (output)
+  {
+    completion_event_ = kernel_event;
+    queue.flush();
+    return true;
+  }
+
+  ranges_.resize(pixel_count);
+  ranges_gpu.readElements(ranges_.data(), pixel_count, 0, &queue, &kernel_event, &completion_event_);
+  completion_event_.wait();
+  return true;
+}
+
+
+void RangeImageGpu::cacheGpuProgram(bool force)
+{
+  if (!force && program_ref_ != nullptr)
+  {
+    // Already loaded.
+    return;
+  }
+
+  releaseGpuProgram();
+
+  program_ref_ = &g_program_ref;
+  if (program_ref_->addReference(gpu_))
+  {
+    range_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), rangeImage);
+    if (!range_kernel_.isValid())
+    {
+      releaseGpuProgram();
+    }
+    else
+    {
+      range_kernel_.calculateOptimalWorkGroupSize();
+    }
+  }
+}
+
+
+void RangeImageGpu::releaseGpuProgram()
+{
+  range_kernel_ = gputil::Kernel();
+
+  if (program_ref_)
+  {
+    program_ref_->releaseReference();
+    program_ref_ = nullptr;
+  }
+}
+}  // namespace ohm
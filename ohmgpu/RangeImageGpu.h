@@ -0,0 +1,158 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_RANGEIMAGEGPU_H
+#define OHMGPU_RANGEIMAGEGPU_H
+
+#include "OhmGpuConfig.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuEvent.h>
+#include <gputil/gpuKernel.h>
+
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+class GpuProgramRef;
+
+/// Projection models for a @c RangeSensor .
+enum class RangeSensorModel : int
+{
+  /// Pinhole camera: x right, y down, z forward. Uses the focal lengths and principal point.
+  kPinhole = 0,
+  /// Spherical projection for lidar: x forward, y left, z up. Columns sweep the azimuth from the minimum to the
+  /// maximum, rows sweep the elevation from the maximum to the minimum.
+  kSpherical = 1
+};
+
+/// Sensor model for @c RangeImageGpu .
+struct ohmgpu_API RangeSensor
+{
+  /// The projection model.
+  RangeSensorModel model = RangeSensorModel::kPinhole;
+  /// Image width (pixels).
+  unsigned width = 640;  // NOLINT(readability-magic-numbers)
+  /// Image height (pixels).
+  unsigned height = 480;  // NOLINT(readability-magic-numbers)
+  /// Pinhole focal length along x (pixels).
+  double fx = 525.0;  // NOLINT(readability-magic-numbers)
+  /// Pinhole focal length along y (pixels).
+  double fy = 525.0;  // NOLINT(readability-magic-numbers)
+  /// Pinhole principal point x (pixels).
+  double cx = 319.5;  // NOLINT(readability-magic-numbers)
+  /// Pinhole principal point y (pixels).
+  double cy = 239.5;  // NOLINT(readability-magic-numbers)
+  /// Spherical minimum azimuth (radians).
+  double min_azimuth = -glm::pi<double>();
+  /// Spherical maximum azimuth (radians).
+  double max_azimuth = glm::pi<double>();
+  /// Spherical minimum elevation (radians).
+  double min_elevation = -glm::pi<double>() / 12.0;  // NOLINT(readability-magic-numbers)
+  /// Spherical maximum elevation (radians).
+  double max_elevation = glm::pi<double>() / 12.0;  // NOLINT(readability-magic-numbers)
+  /// Rays start at this range (metres).
+  double min_range = 0.0;
+  /// Rays end at this range (metres).
+  double max_range = 30.0;  // NOLINT(readability-magic-numbers)
+  /// Pinhole only: write the depth along the camera axis rather than the range along each ray.
+  bool depth = false;
+};
+
+/// GPU ray caster synthesising range or depth images from the occupancy layer of a map.
+///
+/// This supports generating expected sensor images from the map for change detection and simulation. Each pixel
+/// records the range at which its ray first enters an occupied voxel, or zero when there is no occupied voxel within
+/// the @c RangeSensor::min_range and @c RangeSensor::max_range . Unobserved voxels do not stop rays.
+///
+/// Rays are generated on GPU from the @c RangeSensor model, so only the sensor pose is transferred per render. Empty
+/// space is skipped hierarchically: the kernel walks a dense grid of the regions covering the sensor range, crossing
+/// regions without occupied voxels in a single step, and otherwise only traverses the voxels within the bounds of
+/// the region's occupied voxels. Region bounds come from the cached @c RegionStatistics , so repeated renders only
+/// rescan regions modified in the interim. The voxel traversal follows the same region and voxel stepping as the
+/// @c RaysQueryGpu , but without the per ray key and region marshalling on CPU.
+///
+/// The occupancy voxels are read from the map's @c GpuLayerCache , uploading regions as required. The region bounds
+/// are calculated from the host voxels, so a @c GpuMap must synchronise its updates with @c GpuMap::syncVoxels()
+/// before rendering. Packed occupancy caches are not supported.
+///
+/// Results are read back to @c ranges() or, when a buffer is given to @c render() , written to that buffer and left
+/// on GPU. Use @c completionEvent() to synchronise with the latter.
+class ohmgpu_API RangeImageGpu
+{
+public:
+  /// Limit on the number of regions in the region grid.
+  static constexpr size_t kMaxGridRegions = size_t(1u) << 22u;
+
+  /// Constructor.
+  /// @param gpu The GPU device to use.
+  explicit RangeImageGpu(gputil::Device &gpu);
+  /// Destructor.
+  ~RangeImageGpu();
+
+  RangeImageGpu(const RangeImageGpu &) = delete;
+  RangeImageGpu &operator=(const RangeImageGpu &) = delete;
+
+  /// Set the sensor model.
+  /// @param sensor The sensor model.
+  inline void setSensor(const RangeSensor &sensor) { sensor_ = sensor; }
+  /// Query the sensor model.
+  /// @return The sensor model.
+  inline const RangeSensor &sensor() const { return sensor_; }
+
+  /// Render an image of @p map from @p sensor_to_map .
+  ///
+  /// @param map The map to render.
+  /// @param sensor_to_map The sensor pose in the map frame.
+  /// @param output Optional GPU buffer to receive the image, resized as required. The image is read back to
+  ///   @c ranges() when null, otherwise the call does not wait for the kernel to complete.
+  /// @return True on success, false if the GPU program is unavailable, the sensor range spans too many regions or
+  ///   the GPU cache cannot hold the regions in range.
+  bool render(OccupancyMap &map, const glm::dmat4 &sensor_to_map, gputil::Buffer *output = nullptr);
+
+  /// Access the image read back from the last @c render() call without an output buffer. Pixels are in row major
+  /// order: @c RangeSensor::width by @c RangeSensor::height .
+  /// @return The image ranges or depths (metres).
+  inline const std::vector<float> &ranges() const { return ranges_; }
+
+  /// Access the event marking completion of the last @c render() .
+  /// @return The completion event.
+  inline const gputil::Event &completionEvent() const { return completion_event_; }
+
+  /// Query the number of regions in the region grid of the last @c render() .
+  /// @return The region grid size.
+  inline size_t gridRegionCount() const { return grid_region_count_; }
+
+  /// Query the number of regions uploaded for the last @c render() : those with occupied voxels in range.
+  /// @return The occupied region count.
+  inline size_t occupiedRegionCount() const { return occupied_region_count_; }
+
+private:
+  void cacheGpuProgram(bool force);
+  void releaseGpuProgram();
+
+  gputil::Device gpu_;
+  gputil::Kernel range_kernel_;
+  GpuProgramRef *program_ref_ = nullptr;
+  /// Sensor and map parameters: a single @c RangeImageParams .
+  gputil::Buffer gpu_params_;
+  /// The dense region grid of @c RangeImageRegion items.
+  gputil::Buffer gpu_regions_;
+  /// Image buffer used when not rendering to a caller supplied buffer.
+  gputil::Buffer gpu_ranges_;
+  gputil::Event completion_event_;
+  std::vector<float> ranges_;
+  RangeSensor sensor_;
+  size_t grid_region_count_ = 0;
+  size_t occupied_region_count_ = 0;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_RANGEIMAGEGPU_H
@@ -29,7 +29,62 @@ RaysQueryGpu::RaysQueryGpu()
 
 
 RaysQueryGpu::~RaysQueryGpu()
-{}
+{
+  // Ensure any asynchronous query completes before the GPU interface is released.
+  wait();
+}
+
+
+void RaysQueryGpu::setReduction(unsigned reduce_flags, unsigned group_size)
+{
+  RaysQueryDetailGpu *d = imp();
+  d->reduce_flags = (group_size) ? reduce_flags : 0u;
+  d->reduce_group_size = (reduce_flags) ? group_size : 0u;
+  d->gpu_interface->setReduction(d->reduce_flags, d->reduce_group_size);
+}
+
+
+unsigned RaysQueryGpu::reduceFlags() const
+{
+  return imp()->reduce_flags;
+}
+
+
+unsigned RaysQueryGpu::reduceGroupSize() const
+{
+  return imp()->reduce_group_size;
+}
+
+
+const RaysQueryReduceResult *RaysQueryGpu::reductions(size_t *count) const
+{
+  const std::vector<RaysQueryReduceResult> &reductions = imp()->gpu_interface->reductions();
+  if (count)
+  {
+    *count = reductions.size();
+  }
+  return reductions.data();
+}
+
+
+void RaysQueryGpu::setOutputBuffer(gputil::Buffer *buffer)
+{
+  RaysQueryDetailGpu *d = imp();
+  d->output_buffer = buffer;
+  d->gpu_interface->setOutputBuffer(buffer);
+}
+
+
+gputil::Buffer *RaysQueryGpu::outputBuffer() const
+{
+  return imp()->output_buffer;
+}
+
+
+const gputil::Event &RaysQueryGpu::resultsEvent() const
+{
+  return imp()->gpu_interface->resultsEvent();
+}
 
 
 void RaysQueryGpu::onSetMap()
@@ -49,7 +104,12 @@ bool RaysQueryGpu::onExecute()
     return false;
   }
 
-  if (!onExecuteAsync())
+  if (!(d->query_flags & kQfGpuEvaluate))
+  {
+    return RaysQuery::onExecute();
+  }
+
+  if (!startGpuQuery())
   {
     return false;
   }
@@ -72,12 +132,35 @@ bool RaysQueryGpu::onExecuteAsync()
 
   if (!(d->query_flags & kQfGpuEvaluate))
   {
-    return RaysQuery::onExecute();
+    return RaysQuery::onExecuteAsync();
+  }
+
+  if (!startGpuQuery())
+  {
+    return false;
+  }
+
+  // Synchronise the results once the results event fires.
+  return completeAsync([this]() {
+    sync();
+    return true;
+  });
+}
+
+
+bool RaysQueryGpu::startGpuQuery()
+{
+  RaysQueryDetailGpu *d = imp();
+
+  if (d->rays_in.empty())
+  {
+    return false;
   }
 
   // For GPU we use floating point precision.
   d->gpu_interface->setVolumeCoefficient(float(volumeCoefficient()));
-  return d->gpu_interface->integrateRays(d->rays_in.data(), d->rays_in.size()) == d->rays_in.size();
+  d->gpu_pending = d->gpu_interface->integrateRays(d->rays_in.data(), d->rays_in.size()) == d->rays_in.size();
+  return d->gpu_pending;
 }
 
 
@@ -91,8 +174,9 @@ void RaysQueryGpu::onReset(bool hard_reset)
 void RaysQueryGpu::sync()
 {
   RaysQueryDetailGpu *d = imp();
-  if (d->query_flags & kQfGpuEvaluate)
+  if ((d->query_flags & kQfGpuEvaluate) && d->gpu_pending)
   {
+    d->gpu_pending = false;
     RaysQueryDetailGpu *d = imp();
     d->gpu_interface->syncVoxels();
 
@@ -9,6 +9,14 @@
 
 #include <ohm/RaysQuery.h>
 
+#include <ohmgpu/gpu/RaysQueryResult.h>
+
+namespace gputil
+{
+class Buffer;
+class Event;
+}  // namespace gputil
+
 namespace ohm
 {
 struct RaysQueryDetailGpu;
@@ -22,8 +30,29 @@ struct RaysQueryDetailGpu;
 ///
 /// The actual timing results will vary depending on GPU API, GPU architecture, voxel size, query ray lengths and map
 /// environment.
+///
+/// The query may avoid reading back per ray results when only a summary is required, such as the total unobserved
+/// volume for each candidate view of a view planner. @c setReduction() reduces the results for contiguous groups of
+/// rays on GPU, yielding @c reductions() in place of the per ray results. @c setOutputBuffer() additionally keeps the
+/// results - reduced or per ray - on GPU in a caller supplied buffer, skipping the readback entirely.
 class ohmgpu_API RaysQueryGpu : public RaysQuery
 {
+public:
+  /// Flags selecting the GPU reductions for @c setReduction() .
+  enum ReduceFlag : unsigned
+  {
+    /// No reduction: per ray results.
+    kReduceNone = 0u,
+    /// Sum the unobserved volume: @c RaysQueryReduceResult::unobserved_volume .
+    kReduceSum = RQ_ReduceSum,
+    /// Minimum range: @c RaysQueryReduceResult::min_range .
+    kReduceMin = RQ_ReduceMin,
+    /// Count occupied terminal voxels: @c RaysQueryReduceResult::occupied_count .
+    kReduceAnyOccupied = RQ_ReduceAnyOccupied,
+    /// All reductions.
+    kReduceAll = kReduceSum | kReduceMin | kReduceAnyOccupied
+  };
+
 protected:
   /// Constructor used for inherited objects. This supports deriving @p RaysQueryDetail into
   /// more specialised forms.
@@ -38,13 +67,59 @@ public:
   /// Destructor.
   ~RaysQueryGpu() override;
 
+  /// Reduce the results on GPU for each group of @p group_size consecutive rays (origin/end point pairs). Each group
+  /// yields one @c RaysQueryReduceResult with the requested reductions and the per ray results are not populated.
+  /// The last group may hold fewer rays.
+  ///
+  /// Only supported for GPU evaluation (@c kQfGpuEvaluate ).
+  ///
+  /// @param reduce_flags The @c ReduceFlag values to calculate. Zero disables reduction.
+  /// @param group_size The number of rays in each group. Zero disables reduction.
+  void setReduction(unsigned reduce_flags, unsigned group_size);
+
+  /// Query the @c ReduceFlag values set by @c setReduction() .
+  /// @return The reduction flags, zero when not reducing.
+  unsigned reduceFlags() const;
+
+  /// Query the reduction group size set by @c setReduction() .
+  /// @return The number of rays per reduction group, zero when not reducing.
+  unsigned reduceGroupSize() const;
+
+  /// Access the reduced results from the last GPU query. Empty when not reducing or when using an
+  /// @c outputBuffer() .
+  /// @param[out] count Optionally set to the number of reduced results - the number of ray groups.
+  /// @return The reduced results.
+  const RaysQueryReduceResult *reductions(size_t *count = nullptr) const;
+
+  /// Set a GPU buffer to receive the query results, leaving them on GPU without readback. The buffer receives either
+  /// one @c RaysQueryReduceResult per ray group when reducing, or one @c RaysQueryResult per ray. The buffer is
+  /// allocated or enlarged as required and must remain valid until cleared or the query is destroyed.
+  ///
+  /// The host results are not populated while an output buffer is set. Use @c wait() or @c resultsEvent() to
+  /// synchronise with the GPU results.
+  ///
+  /// @param buffer The buffer to write to or null to read results back to host.
+  void setOutputBuffer(gputil::Buffer *buffer);
+
+  /// Query the buffer set by @c setOutputBuffer() .
+  /// @return The output buffer or null.
+  gputil::Buffer *outputBuffer() const;
+
+  /// Access the event marking completion of the last GPU query results, including any readback.
+  /// @return The results event.
+  const gputil::Event &resultsEvent() const;
+
 protected:
   void onSetMap() override;
   bool onExecute() override;
   bool onExecuteAsync() override;
   void onReset(bool hard_reset) override;
 
-  /// Synchronise GPU results
+  /// Queue the GPU query for the current rays.
+  /// @return True if the query was queued.
+  bool startGpuQuery();
+
+  /// Synchronise GPU results, blocking on the GPU results event.
   void sync();
 
   /// Internal pimpl data access.
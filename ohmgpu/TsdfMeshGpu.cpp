@@ -0,0 +1,385 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "TsdfMeshGpu.h"
+
+#include "GpuCache.h"
+#include "GpuLayerCache.h"
+#include "GpuMap.h"
+
+#include "private/GpuMapDetail.h"
+#include "private/GpuProgramRef.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelTsdf.h>
+
+#include <ohmutil/PlyMesh.h>
+
+#include <gputil/gpuEventList.h>
+#include <gputil/gpuPlatform.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <array>
+#include <iostream>
+#include <unordered_set>
+
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+#include "TsdfMeshResource.h"
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+#if GPUTIL_TYPE == GPUTIL_CUDA
+GPUTIL_CUDA_DECLARE_KERNEL(tsdfMesh);
+#endif  // GPUTIL_TYPE == GPUTIL_CUDA
+
+namespace ohm
+{
+namespace
+{
+#if defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("TsdfMesh", GpuProgramRef::kSourceString,  // NOLINT
+                            TsdfMeshCode, TsdfMeshCode_length);
+#else   // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+// NOLINTNEXTLINE(cert-err58-cpp)
+GpuProgramRef g_program_ref("TsdfMesh", GpuProgramRef::kSourceFile, "TsdfMesh.cl", 0u);
+#endif  // defined(OHM_EMBED_GPU_CODE) && GPUTIL_TYPE == GPUTIL_OPENCL
+
+/// Number of regions sampled to mesh a region: the region and its neighbours along the positive axes.
+constexpr unsigned kMeshRegionCount = 8u;
+/// Memory offset marking a missing region. Matches @c TM_NoRegion .
+constexpr uint64_t kNoRegion = ~uint64_t(0u);
+/// Initial vertex capacity of the GPU vertex buffer.
+constexpr unsigned kInitialVertexCapacity = 3u * 16u * 1024u;
+
+/// Offset to the neighbour region at @p index in the kernel ordering (x | y << 1 | z << 2).
+glm::i16vec3 neighbourOffset(unsigned index)
+{
+  return glm::i16vec3(int16_t(index & 1u), int16_t((index >> 1u) & 1u), int16_t((index >> 2u) & 1u));
+}
+}  // namespace
+
+TsdfMeshGpu::TsdfMeshGpu(gputil::Device &gpu)
+  : gpu_(gpu)
+{
+  gpu_region_offsets_ = gputil::Buffer(gpu, kMeshRegionCount * sizeof(uint64_t), gputil::kBfReadHost);
+  gpu_vertices_ = gputil::Buffer(gpu, kInitialVertexCapacity * 3u * sizeof(float), gputil::kBfWriteHost);
+  gpu_vertex_count_ = gputil::Buffer(gpu, sizeof(uint32_t), gputil::kBfReadWriteHost);
+}
+
+
+TsdfMeshGpu::~TsdfMeshGpu()
+{
+  gpu_region_offsets_ = gputil::Buffer();
+  gpu_vertices_ = gputil::Buffer();
+  gpu_vertex_count_ = gputil::Buffer();
+  releaseGpuProgram();
+  gpu_ = gputil::Device();
+}
+
+
+bool TsdfMeshGpu::extractRegion(OccupancyMap &map, const glm::i16vec3 &region_key)
+{
+  cacheGpuProgram(false);
+  if (!mesh_kernel_.isValid())
+  {
+    return false;
+  }
+
+  const int tsdf_layer = map.layout().layerIndex(default_layer::tsdfLayerName());
+  if (tsdf_layer < 0)
+  {
+    return false;
+  }
+
+  GpuCache *gpu_cache = initialiseGpuCache(map, GpuCache::kDefaultTargetMemSize, gpumap::kGpuAllowMappedBuffers);
+  GpuLayerCache *tsdf_cache = gpu_cache->layerCache(kGcIdTsdf);
+  if (!tsdf_cache)
+  {
+    return false;
+  }
+
+  if (!map.region(region_key, false))
+  {
+    // No region, no mesh.
+    meshes_.erase(region_key);
+    return true;
+  }
+
+  // Upload - or resolve - the region and its positive neighbours. Using upload() rather than lookup() ensures all
+  // regions are locked by the batch marker, so resolving one cannot evict another.
+  std::array<uint64_t, kMeshRegionCount> region_offsets{};
+  gputil::EventList upload_events;
+  const unsigned batch_marker = tsdf_cache->beginBatch();
+  for (unsigned i = 0; i < kMeshRegionCount; ++i)
+  {
+    const glm::i16vec3 neighbour_key = region_key + neighbourOffset(i);
+    MapChunk *chunk = map.region(neighbour_key, false);
+    if (!chunk)
+    {
+      region_offsets[i] = kNoRegion;
+      continue;
+    }
+
+    gputil::Event upload_event;
+    GpuLayerCache::CacheStatus status;
+    region_offsets[i] = uint64_t(tsdf_cache->upload(map, neighbour_key, chunk, &upload_event, &status, batch_marker,
+                                                    GpuLayerCache::kSkipDownload));
+    if (status == GpuLayerCache::kCacheFull)
+    {
+      std::cerr << "TsdfMeshGpu: GPU cache full. Results invalid.\n" << std::flush;
+      return false;
+    }
+
+    if (upload_event.isValid())
+    {
+      upload_events.add(upload_event);
+    }
+  }
+  gpu_region_offsets_.write(region_offsets.data(), sizeof(region_offsets));
+
+  const glm::ivec3 region_dim = map.regionVoxelDimensions();
+  const gputil::int3 region_dim_gpu = { region_dim.x, region_dim.y, region_dim.z };
+  const auto voxel_order = unsigned(map.layerVoxelOrder(tsdf_layer));
+  gputil::Dim3 global_size;
+  gputil::Dim3 local_size;
+  mesh_kernel_.calculateGrid(&global_size, &local_size, gputil::Dim3(size_t(map.regionVoxelVolume())));
+
+  gputil::Queue &queue = gpu_cache->gpuQueue();
+  gputil::Event kernel_event;
+  uint32_t vertex_count = 0;
+
+  // Run the kernel, resizing and running again if the vertex buffer overflows.
+  for (int attempt = 0; attempt < 2; ++attempt)
+  {
+    const uint32_t zero = 0u;
+    gpu_vertex_count_.write(&zero, sizeof(zero));
+    const auto max_vertices = unsigned(gpu_vertices_.size() / (3u * sizeof(float)));
+
+    const int err = mesh_kernel_(global_size, local_size, upload_events, kernel_event, &queue,
+                                 // Kernel arguments
+                                 gputil::BufferArg<VoxelTsdf>(*tsdf_cache->buffer()),
+                                 gputil::BufferArg<uint64_t>(gpu_region_offsets_), region_dim_gpu, voxel_order,
+                                 float(map.resolution()), min_weight_, gputil::BufferArg<float>(gpu_vertices_),
+                                 max_vertices, gputil::BufferArg<uint32_t>(gpu_vertex_count_));
+    if (err)
+    {
+      return false;
+    }
+
+    gpu_vertex_count_.read(&vertex_count, sizeof(vertex_count), 0, nullptr, &kernel_event);
+    if (vertex_count <= max_vertices)
+    {
+      break;
+    }
+
+    gpu_vertices_.elementsResize<float>(size_t(vertex_count) * 3u);
+  }
+
+  // Lock the TSDF regions with the kernel so they are not modified before we complete.
+  tsdf_cache->updateEvents(batch_marker, kernel_event);
+
+  if (vertex_count == 0)
+  {
+    meshes_.erase(region_key);
+    return true;
+  }
+
+  std::vector<float> triangle_vertices(size_t(vertex_count) * 3u);
+  gpu_vertices_.read(triangle_vertices.data(), triangle_vertices.size() * sizeof(float), 0, nullptr, &kernel_event);
+
+  // Weld the triangle vertices. Shared vertices are bitwise equal.
+  RegionMesh &mesh = meshes_[region_key];
+  mesh.origin = map.regionSpatialMin(region_key);
+  mesh.vertices.clear();
+  mesh.indices.clear();
+  std::unordered_map<glm::vec3, unsigned, Vector3Hash<glm::vec3>> vertex_map;
+  for (size_t t = 0; t + 9 <= triangle_vertices.size(); t += 9)
+  {
+    std::array<unsigned, 3> triangle{};
+    for (size_t v = 0; v < 3; ++v)
+    {
+      const glm::vec3 vertex = glm::make_vec3(&triangle_vertices[t + v * 3]);
+      const auto inserted = vertex_map.emplace(vertex, unsigned(mesh.vertices.size()));
+      if (inserted.second)
+      {
+        mesh.vertices.emplace_back(vertex);
+      }
+      triangle[v] = inserted.first->second;
+    }
+
+    // Skip degenerate triangles, which occur when the surface passes through a voxel centre.
+    if (triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2])
+    {
+      mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+    }
+  }
+
+  return true;
+}
+
+
+int TsdfMeshGpu::update(OccupancyMap &map)
+{
+  const int tsdf_layer = map.layout().layerIndex(default_layer::tsdfLayerName());
+  if (tsdf_layer < 0)
+  {
+    return -1;
+  }
+
+  // Remove meshes for regions which no longer exist.
+  for (auto iter = meshes_.begin(); iter != meshes_.end();)
+  {
+    if (!map.region(iter->first, false))
+    {
+      iter = meshes_.erase(iter);
+    }
+    else
+    {
+      ++iter;
+    }
+  }
+
+  // Resolve the modified regions. A region's mesh also samples its positive neighbours, so a modified region dirties
+  // the mesh of its negative neighbours as well.
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  std::unordered_set<glm::i16vec3, Vector3Hash<glm::i16vec3>> dirty_regions;
+  for (const MapChunk *chunk : chunks)
+  {
+    if (!have_update_stamp_ || chunk->touched_stamps[tsdf_layer] > update_stamp_)
+    {
+      for (unsigned i = 0; i < kMeshRegionCount; ++i)
+      {
+        const glm::i16vec3 region_key = chunk->region.coord - neighbourOffset(i);
+        if (i == 0 || map.region(region_key, false))
+        {
+          dirty_regions.insert(region_key);
+        }
+      }
+    }
+  }
+
+  // Note the stamp before meshing then advance it. Resolving regions in the GPU cache may touch them with the current
+  // stamp, which must not count as a modification.
+  const uint64_t update_stamp = map.stamp();
+  int meshed = 0;
+  for (const glm::i16vec3 &region_key : dirty_regions)
+  {
+    if (!extractRegion(map, region_key))
+    {
+      return -1;
+    }
+    ++meshed;
+  }
+
+  map.touch();
+  update_stamp_ = update_stamp;
+  have_update_stamp_ = true;
+  return meshed;
+}
+
+
+void TsdfMeshGpu::clear()
+{
+  meshes_.clear();
+  update_stamp_ = 0;
+  have_update_stamp_ = false;
+}
+
+
+const TsdfMeshGpu::RegionMesh *TsdfMeshGpu::regionMesh(const glm::i16vec3 &region_key) const
+{
+  const auto iter = meshes_.find(region_key);
+  return (iter != meshes_.end()) ? &iter->second : nullptr;
+}
+
+
+size_t TsdfMeshGpu::triangleCount() const
+{
+  size_t count = 0;
+  for (const auto &entry : meshes_)
+  {
+    count += entry.second.indices.size() / 3u;
+  }
+  return count;
+}
+
+
+void TsdfMeshGpu::exportMesh(std::vector<glm::dvec3> &vertices, std::vector<unsigned> &indices) const
+{
+  for (const auto &entry : meshes_)
+  {
+    const RegionMesh &mesh = entry.second;
+    const auto index_offset = unsigned(vertices.size());
+    for (const glm::vec3 &vertex : mesh.vertices)
+    {
+      vertices.emplace_back(mesh.origin + glm::dvec3(vertex));
+    }
+    for (const unsigned index : mesh.indices)
+    {
+      indices.emplace_back(index_offset + index);
+    }
+  }
+}
+
+
+void TsdfMeshGpu::exportMesh(PlyMesh &mesh) const
+{
+  std::vector<glm::dvec3> vertices;
+  std::vector<unsigned> indices;
+  exportMesh(vertices, indices);
+  if (!vertices.empty())
+  {
+    const unsigned index_offset = mesh.addVertices(vertices.data(), unsigned(vertices.size()));
+    for (unsigned &index : indices)
+    {
+      index += index_offset;
+    }
+    mesh.addTriangles(indices.data(), unsigned(indices.size() / 3u));
+  }
+}
+
+
+void TsdfMeshGpu::cacheGpuProgram(bool force)
+{
+  if (!force && program_ref_ != nullptr)
+  {
+    // Already loaded.
+    return;
+  }
+
+  releaseGpuProgram();
+
+  program_ref_ = &g_program_ref;
+  if (program_ref_->addReference(gpu_))
+  {
+    mesh_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), tsdfMesh);
+    if (!mesh_kernel_.isValid())
+    {
+      releaseGpuProgram();
+    }
+    else
+    {
+      mesh_kernel_.calculateOptimalWorkGroupSize();
+    }
+  }
+}
+
+
+void TsdfMeshGpu::releaseGpuProgram()
+{
+  mesh_kernel_ = gputil::Kernel();
+
+  if (program_ref_)
+  {
+    program_ref_->releaseReference();
+    program_ref_ = nullptr;
+  }
+}
+}  // namespace ohm
@@ -0,0 +1,139 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_TSDFMESHGPU_H
+#define OHMGPU_TSDFMESHGPU_H
+
+#include "OhmGpuConfig.h"
+
+#include <glm/glm.hpp>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuKernel.h>
+
+#include <ohmutil/VectorHash.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+class GpuProgramRef;
+class PlyMesh;
+
+/// GPU algorithm to extract a triangle mesh of the TSDF surface - the zero crossing of the TSDF distance - as fused by
+/// @c GpuTsdfMap or @c RayMapperTsdf .
+///
+/// Meshes are generated per region on GPU directly from the TSDF voxels held in (or uploaded to) the map's
+/// @c GpuLayerCache , so the TSDF layer need not be synchronised to host memory. Each region is meshed using its own
+/// voxels and those of its neighbours along the positive axes, so the region meshes join to form a continuous surface.
+/// Surfaces touching voxels with less than @c minWeight() are skipped.
+///
+/// Meshes are maintained incrementally by @c update() , which re-meshes only the regions modified since the previous
+/// update, along with the neighbours which sample those regions. Region modification is detected using the
+/// @c MapChunk::touched_stamps for the TSDF layer, which are updated whenever @c GpuTsdfMap uploads a region for
+/// update.
+///
+/// The surface is generated by marching tetrahedra, splitting each voxel cube into six tetrahedra. Triangle normals
+/// face away from the surface, towards the sensor. Vertices are shared within a region's mesh, but not between
+/// regions.
+class ohmgpu_API TsdfMeshGpu
+{
+public:
+  /// Triangle mesh for a single region.
+  struct RegionMesh
+  {
+    /// Region minimum corner. Vertices are relative to this point.
+    glm::dvec3 origin{ 0 };
+    /// Vertex positions relative to @c origin .
+    std::vector<glm::vec3> vertices;
+    /// Triangle vertex indices; three per triangle.
+    std::vector<unsigned> indices;
+  };
+
+  /// Region mesh map type.
+  using RegionMeshMap = std::unordered_map<glm::i16vec3, RegionMesh, Vector3Hash<glm::i16vec3>>;
+
+  /// Constructor.
+  /// @param gpu The GPU device to use.
+  explicit TsdfMeshGpu(gputil::Device &gpu);
+  /// Destructor.
+  ~TsdfMeshGpu();
+
+  /// Set the minimum TSDF weight required for a voxel to contribute to the surface.
+  /// @param min_weight The minimum weight.
+  inline void setMinWeight(float min_weight) { min_weight_ = min_weight; }
+  /// Query the minimum TSDF weight required for a voxel to contribute to the surface.
+  /// @return The minimum weight.
+  inline float minWeight() const { return min_weight_; }
+
+  /// (Re)generate the mesh for the region at @p region_key in @p map . Any existing mesh for the region is replaced
+  /// and the region mesh is removed if the surface does not intersect the region.
+  ///
+  /// @param map The TSDF map.
+  /// @param region_key The region to mesh.
+  /// @return True on success, false if the map has no TSDF layer, the GPU program is unavailable or the GPU cache
+  ///   cannot hold the required regions.
+  bool extractRegion(OccupancyMap &map, const glm::i16vec3 &region_key);
+
+  /// Re-mesh all regions of @p map which have been modified since the last @c update() or @c clear() . Meshes for
+  /// regions which are no longer in the map are removed.
+  ///
+  /// @param map The TSDF map.
+  /// @return The number of regions re-meshed or -1 on failure.
+  int update(OccupancyMap &map);
+
+  /// Clear all region meshes. The next @c update() re-meshes the entire map.
+  void clear();
+
+  /// Access the region meshes.
+  /// @return The region meshes.
+  inline const RegionMeshMap &regionMeshes() const { return meshes_; }
+
+  /// Lookup the mesh for @p region_key .
+  /// @param region_key The region of interest.
+  /// @return The region mesh or null if there is no mesh for the region.
+  const RegionMesh *regionMesh(const glm::i16vec3 &region_key) const;
+
+  /// Query the total number of triangles in all region meshes.
+  /// @return The triangle count.
+  size_t triangleCount() const;
+
+  /// Export all region meshes into a single vertex and index array. Vertices are in global map coordinates.
+  /// @param vertices Vertex array to append to.
+  /// @param indices Triangle index array to append to; three per triangle. Indices are offset by the initial
+  ///   @p vertices size.
+  void exportMesh(std::vector<glm::dvec3> &vertices, std::vector<unsigned> &indices) const;
+
+  /// Export all region meshes to @p mesh . Vertices are in global map coordinates.
+  /// @param mesh The mesh to add to.
+  void exportMesh(PlyMesh &mesh) const;
+
+private:
+  void cacheGpuProgram(bool force);
+  void releaseGpuProgram();
+
+  gputil::Device gpu_;
+  gputil::Kernel mesh_kernel_;
+  GpuProgramRef *program_ref_ = nullptr;
+  /// TSDF cache memory offsets for the target region and its positive neighbours.
+  gputil::Buffer gpu_region_offsets_;
+  /// Output triangle vertices.
+  gputil::Buffer gpu_vertices_;
+  /// Output vertex count.
+  gputil::Buffer gpu_vertex_count_;
+  RegionMeshMap meshes_;
+  /// @c OccupancyMap::stamp() at the last @c update() . Regions touched after this are re-meshed.
+  uint64_t update_stamp_ = 0;
+  /// Set after the first @c update() . Until then, all regions are meshed.
+  bool have_update_stamp_ = false;
+  float min_weight_ = 1e-3f;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_TSDFMESHGPU_H
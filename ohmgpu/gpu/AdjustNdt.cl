@@ -15,8 +15,9 @@ inline __device__ float calculateOccupancyAdjustment(const GpuKey *voxel_key, co
   // Note: we always ignore voxels where is_sample_voxel or is_end_voxel is true. Samples are adjusted later while
   // a non-sample is_end_voxel is a split ray.
 
-  const ulonglong vi_local = voxel_key->voxel[0] + voxel_key->voxel[1] * line_data->region_dimensions.x +
-                             voxel_key->voxel[2] * line_data->region_dimensions.x * line_data->region_dimensions.y;
+  const ulonglong vi_local =
+    orderedVoxelIndex(voxel_key->voxel[0], voxel_key->voxel[1], voxel_key->voxel[2], line_data->region_dimensions.x,
+                      line_data->region_dimensions.y, line_data->region_dimensions.z, line_data->voxel_order);
   ulonglong vi = (line_data->means_offsets[line_data->current_region_index] / sizeof(*line_data->means)) + vi_local;
   __global VoxelMean *mean_data = &line_data->means[vi];
 
@@ -10,6 +10,7 @@
 #include "GpuKey.h"
 #include "MapCoord.h"
 #include "VoxelMeanCompute.h"
+#include "VoxelOrderCompute.h"
 
 #include "Regions.cl"
 
@@ -64,6 +65,7 @@
 /// @param line_count number of lines in @p line_keys and @p local_lines. These come in pairs, so the number of elements
 ///     in those arrays is double this value.
 /// @param region_dimensions Specifies the size of any one region in voxels.
+/// @param voxel_order Specifies the order of voxels in region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 /// @param voxel_resolution Specifies the size of a voxel cube.
 /// @param sample_adjustment Specifiest the value adjustment applied to voxels containing the sample point (line end
 ///     point). Should be > 0 to re-enforce as occupied.
@@ -88,7 +90,7 @@ __kernel void covarianceHitNdt(
   __global int3 *occupancy_region_keys_global, uint region_count,                                        //
   __global GpuKey *line_keys, __global float3 *local_lines, uint line_count,                             //
   __global uint *touch_times, __global float *intensities,                                               //
-  int3 region_dimensions, float voxel_resolution, float sample_adjustment, float occupied_threshold,
+  int3 region_dimensions, uint voxel_order, float voxel_resolution, float sample_adjustment, float occupied_threshold,
   float voxel_value_max, float initial_intensity_covariance, unsigned ndt_sample_threshold, float adaptation_rate,
   float sensor_noise, float reinitialise_cov_threshold, unsigned reinitialise_cov_sample_count)
 {
@@ -125,8 +127,9 @@ __kernel void covarianceHitNdt(
     return;
   }
 
-  const uint region_local_index = start_voxel.voxel[0] + start_voxel.voxel[1] * region_dimensions.x +
-                                  start_voxel.voxel[2] * region_dimensions.x * region_dimensions.y;
+  const uint region_local_index =
+    orderedVoxelIndex(start_voxel.voxel[0], start_voxel.voxel[1], start_voxel.voxel[2], region_dimensions.x,
+                      region_dimensions.y, region_dimensions.z, voxel_order);
   uint occupancy_index, mean_index, cov_index;
   uint intensity_index, hit_miss_index;
 
@@ -209,11 +212,14 @@ __kernel void covarianceHitNdt(
       // This indicates the end point is a truncated part of the ray and not a real sample.
       if (target_voxel.voxel[3] == 0)
       {
+        // Read the ray once for all the layer updates below.
+        const float3 sensor = local_lines[i * 2];
+        const float3 sample = local_lines[i * 2 + 1];
         if (hit_miss_voxels)
         {
           const bool reinitialise_permeability_with_covariance = true;  // TODO: make a parameter of map
-          calculateHitMissUpdateOnHit(&work_item.cov, work_item.occupancy, &hit_miss_count, local_lines[i * 2],
-                                      local_lines[i * 2 + 1], work_item.mean, work_item.sample_count, INFINITY,
+          calculateHitMissUpdateOnHit(&work_item.cov, work_item.occupancy, &hit_miss_count, sensor, sample,
+                                      work_item.mean, work_item.sample_count, INFINITY,
                                       reinitialise_permeability_with_covariance, adaptation_rate, sensor_noise,
                                       reinitialise_cov_threshold, reinitialise_cov_sample_count, ndt_sample_threshold);
         }
@@ -225,7 +231,7 @@ __kernel void covarianceHitNdt(
         }
         if (traversal_voxels)
         {
-          traversal += calculateTraversal(local_lines[i * 2], local_lines[i * 2 + 1], voxel_resolution);
+          traversal += calculateTraversal(sensor, sample, voxel_resolution);
         }
 
         if (touch_times)
@@ -237,13 +243,11 @@ __kernel void covarianceHitNdt(
         {
           // The sample count won't be increment for the current point yet. That's the behaviour we want for the
           // progressive average.
-          incident =
-            updateIncidentNormal(incident, local_lines[i * 2] - local_lines[i * 2 + 1], work_item.sample_count);
+          incident = updateIncidentNormal(incident, sensor - sample, work_item.sample_count);
         }
 
-        collateSample(&work_item, local_lines[i * 2], local_lines[i * 2 + 1], region_dimensions, voxel_resolution,
-                      sample_adjustment, occupied_threshold, sensor_noise, reinitialise_cov_threshold,
-                      reinitialise_cov_sample_count);
+        collateSample(&work_item, sensor, sample, region_dimensions, voxel_resolution, sample_adjustment,
+                      occupied_threshold, sensor_noise, reinitialise_cov_threshold, reinitialise_cov_sample_count);
         ++added;
       }
     }
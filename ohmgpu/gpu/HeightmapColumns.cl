@@ -0,0 +1,203 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpu_ext.h"  // Must be first
+
+// Explicitly include MapCoord.h first.
+#include "MapCoord.h"
+
+#include "GpuKey.h"
+#include "HeightmapColumnsResult.h"
+#include "VoxelOrderCompute.h"
+
+#include "Regions.cl"
+
+/// @defgroup heightmapColumnsGpu Heightmap Columns GPU
+/// @{
+/// @brief GPU code used to extract heightmap surface candidates from vertical columns of occupancy voxels.
+///
+/// Each GPU thread processes a single column of voxels aligned with the heightmap up axis. The column footprint is one
+/// region in the plane of the heightmap, so the global work size matches the region dimensions along the two
+/// horizontal axes. Columns start at the @c base_key voxel and extend @c column_height voxels up.
+///
+/// Columns are walked from the top down, tracking the number of consecutive non-occupied voxels above the current
+/// voxel. A voxel is a surface candidate where:
+/// - it lies at or below the @c search_top index (the heightmap ceiling),
+/// - it is occupied (@c HC_Surface ) or, with @c HC_FlagVirtualSurfaces , it is free with an unobserved voxel below
+///   it (@c HC_VirtualSurface ),
+/// - and it has at least @c clearance_voxels non-occupied voxels above it, or is clear to the top of the column.
+///
+/// Without @c HC_FlagLayered a single result is generated per column, choosing the candidate closest to the
+/// @c reference_index voxel with ties favouring candidates below the reference. Virtual surfaces are not accepted
+/// above the reference. With @c HC_FlagLayered up to @c max_layers results are written, ordered from the top of the
+/// column down. Unused result slots are marked @c HC_None .
+///
+/// Occupancy data for all regions are maintained in a single GPU buffer cache (see @c GpuLayerCache) as for other
+/// ohm GPU algorithms, resolved using @c occupancy_region_keys and the byte offsets in
+/// @c occupancy_region_mem_offsets . Missing regions are treated as unobserved.
+
+#ifndef HEIGHTMAP_COLUMNS_CL
+#define HEIGHTMAP_COLUMNS_CL
+/// Extract the component of @p v for @p axis (0, 1, 2 => x, y, z).
+inline __device__ int hcAxisValue(int3 v, int axis)
+{
+  return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+}
+
+
+/// Read the occupancy value for @p key or @c INFINITY if the region is not available.
+inline __device__ float hcVoxelValue(const GpuKey *key, __global float *occupancy,
+                                     __global ulonglong *occupancy_region_mem_offsets,
+                                     __global int3 *occupancy_region_keys, uint region_count, int3 region_dimensions,
+                                     uint voxel_order, int3 *current_region, uint *region_index)
+{
+  if (!regionsResolveRegion(key, current_region, region_index, occupancy_region_keys, region_count))
+  {
+    return INFINITY;
+  }
+
+  const ulonglong vi_local = orderedVoxelIndex(key->voxel[0], key->voxel[1], key->voxel[2], region_dimensions.x,
+                                               region_dimensions.y, region_dimensions.z, voxel_order);
+  return occupancy[occupancy_region_mem_offsets[*region_index] / sizeof(*occupancy) + vi_local];
+}
+
+
+/// Convert an occupancy value into a column voxel type: -1 unobserved, 0 free, 1 occupied.
+inline __device__ int hcVoxelType(float value, float occupied_threshold)
+{
+  return (value == INFINITY) ? -1 : ((value >= occupied_threshold) ? 1 : 0);
+}
+#endif  // HEIGHTMAP_COLUMNS_CL
+
+
+__kernel void heightmapColumns(__global float *occupancy, __global ulonglong *occupancy_region_mem_offsets,
+                               __global int3 *occupancy_region_keys, uint region_count, int3 region_dimensions,
+                               uint voxel_order, float occupied_threshold, __global GpuKey *base_key, int3 axes,
+                               int column_height, int search_top, int reference_index, int clearance_voxels,
+                               uint flags, int max_layers, __global HeightmapColumnsResult *results)
+{
+  const int column_x = (int)get_global_id(0);
+  const int column_y = (int)get_global_id(1);
+  const int columns_x = hcAxisValue(region_dimensions, axes.x);
+  const int columns_y = hcAxisValue(region_dimensions, axes.y);
+
+  if (column_x >= columns_x || column_y >= columns_y)
+  {
+    return;
+  }
+
+  __global HeightmapColumnsResult *column_results = &results[(column_y * columns_x + column_x) * max_layers];
+  const bool layered = (flags & HC_FlagLayered) != 0;
+  const bool virtual_surfaces = (flags & HC_FlagVirtualSurfaces) != 0;
+
+  HeightmapColumnsResult below_result;
+  HeightmapColumnsResult above_result;
+  below_result.type = above_result.type = HC_None;
+  below_result.voxel_index = above_result.voxel_index = -1;
+  below_result.clearance_voxels = above_result.clearance_voxels = 0;
+  below_result.flags = above_result.flags = 0u;
+  int layer_count = 0;
+
+  // Resolve the top voxel of the column.
+  GpuKey key;
+  copyKey(&key, base_key);
+  moveKeyAlongAxis(&key, axes.x, column_x, region_dimensions);
+  moveKeyAlongAxis(&key, axes.y, column_y, region_dimensions);
+  moveKeyAlongAxis(&key, axes.z, column_height - 1, region_dimensions);
+
+  int3 current_region;
+  uint region_index;
+  regionsInitCurrent(&current_region, &region_index);
+
+  int voxel_type = hcVoxelType(hcVoxelValue(&key, occupancy, occupancy_region_mem_offsets, occupancy_region_keys,
+                                            region_count, region_dimensions, voxel_order, &current_region,
+                                            &region_index),
+                               occupied_threshold);
+  int free_run = 0;
+  bool observed_above = false;
+
+  for (int i = column_height - 1; i >= 0; --i)
+  {
+    // Lookup the voxel below for virtual surface detection and the next iteration.
+    int below_type = -1;
+    if (i > 0)
+    {
+      stepKeyAlongAxis(&key, axes.z, -1, region_dimensions);
+      below_type = hcVoxelType(hcVoxelValue(&key, occupancy, occupancy_region_mem_offsets, occupancy_region_keys,
+                                            region_count, region_dimensions, voxel_order, &current_region,
+                                            &region_index),
+                               occupied_threshold);
+    }
+
+    if (i <= search_top)
+    {
+      const int candidate_type = (voxel_type == 1) ?
+                                   HC_Surface :
+                                   ((virtual_surfaces && voxel_type == 0 && below_type == -1) ? HC_VirtualSurface :
+                                                                                                 HC_None);
+      const bool clear = free_run >= clearance_voxels || free_run == column_height - 1 - i;
+
+      if (candidate_type != HC_None && clear)
+      {
+        HeightmapColumnsResult candidate;
+        candidate.voxel_index = i;
+        candidate.clearance_voxels = free_run;
+        candidate.type = candidate_type;
+        candidate.flags = (observed_above) ? HC_ResultObservedAbove : 0u;
+
+        if (layered)
+        {
+          column_results[layer_count++] = candidate;
+          if (layer_count >= max_layers)
+          {
+            break;
+          }
+        }
+        else if (i <= reference_index)
+        {
+          // First candidate at or below the reference is the closest below. Nothing more to find.
+          below_result = candidate;
+          break;
+        }
+        else if (candidate_type == HC_Surface)
+        {
+          // Keep overwriting to find the lowest surface above the reference.
+          above_result = candidate;
+        }
+      }
+    }
+
+    free_run = (voxel_type == 1) ? 0 : free_run + 1;
+    observed_above = observed_above || voxel_type != -1;
+    voxel_type = below_type;
+  }
+
+  if (!layered)
+  {
+    if (below_result.type != HC_None && above_result.type != HC_None)
+    {
+      // Choose the closest, favouring below.
+      column_results[0] = (above_result.voxel_index - reference_index < reference_index - below_result.voxel_index) ?
+                            above_result :
+                            below_result;
+    }
+    else
+    {
+      column_results[0] = (below_result.type != HC_None) ? below_result : above_result;
+    }
+    layer_count = 1;
+  }
+
+  // Clear unused slots.
+  for (int i = layer_count; i < max_layers; ++i)
+  {
+    column_results[i].voxel_index = -1;
+    column_results[i].clearance_voxels = 0;
+    column_results[i].type = HC_None;
+    column_results[i].flags = 0u;
+  }
+}
+
+/// @}
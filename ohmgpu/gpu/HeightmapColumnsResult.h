@@ -0,0 +1,42 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPU_HEIGHTMAPCOLUMNS_RESULT_H
+#define OHMGPU_GPU_HEIGHTMAPCOLUMNS_RESULT_H
+
+#ifndef HC_None
+/// No surface candidate found in the column (or layer slot).
+#define HC_None (0)
+/// Real surface: an occupied voxel.
+#define HC_Surface (1)
+/// Virtual surface: a free voxel supported by an unobserved voxel.
+#define HC_VirtualSurface (2)
+#endif  // HC_None
+
+#ifndef HC_FlagVirtualSurfaces
+/// Kernel flag: generate virtual surface candidates.
+#define HC_FlagVirtualSurfaces (1 << 0)
+/// Kernel flag: generate multiple layers per column rather than a single planar result.
+#define HC_FlagLayered (1 << 1)
+/// Result flag: an observed voxel exists above the candidate.
+#define HC_ResultObservedAbove (1 << 0)
+#endif  // HC_FlagVirtualSurfaces
+
+/// Structure used to write results for a @c HeightmapColumnsGpu query. There are @c max_layers results per column with
+/// unused slots marked as @c HC_None.
+typedef struct HeightmapColumnsResult_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Index of the candidate voxel along the column, relative to the column base voxel. Only valid when @c type is not
+  /// @c HC_None.
+  int voxel_index;
+  /// Number of non-occupied voxels directly above the candidate voxel.
+  int clearance_voxels;
+  /// The candidate type: @c HC_None , @c HC_Surface or @c HC_VirtualSurface .
+  int type;
+  /// Result flags, e.g., @c HC_ResultObservedAbove .
+  unsigned flags;
+} HeightmapColumnsResult;
+
+#endif  // OHMGPU_GPU_HEIGHTMAPCOLUMNS_RESULT_H
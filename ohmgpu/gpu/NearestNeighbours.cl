@@ -0,0 +1,161 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpu_ext.h"  // Must be first
+
+#include "NearestNeighboursResult.h"
+#include "VoxelOrderCompute.h"
+
+/// @defgroup nearestNeighboursGpu Nearest Neighbours GPU
+/// @{
+/// @brief GPU code used to find the obstructed voxels within a search radius of a batch of query points.
+///
+/// Each query point searches a cube of @c cube_dim voxels per axis, starting at the point's cube min voxel - see
+/// @c NearestNeighboursPoint . The global work size is two dimensional: the first dimension covers the voxels of the
+/// search cube, the second the query points. Voxels are obstructed when occupied or, with
+/// @c NN_FlagUnknownAsOccupied , unobserved. Only voxels with centres within @c search_radius of the query point are
+/// reported.
+///
+/// The regions overlapped by each search cube are resolved using a fixed size region table per point of
+/// @c region_span regions per axis, starting at the region containing the cube min voxel. Each entry is a byte offset
+/// into the @c occupancy cache buffer (see @c GpuLayerCache) or @c NN_NoRegion for a missing region, which is treated
+/// as unobserved.
+///
+/// Results are appended to @c results using an atomic @c result_count . The @c result_count is incremented for all
+/// results, but no results are written beyond @c max_results , allowing the caller to detect overflow and resize.
+///
+/// With @c NN_FlagNearestResult , results are reduced to the nearest voxel per point in @c nearest instead, using two
+/// invocations. There are two entries per point, initialised to ~0u. The @c NN_PassNearestRange pass reduces the
+/// minimum squared range - as bits; positive floats order as unsigned integers - into the first entry. The
+/// @c NN_PassNearestVoxel pass reduces the lowest cube voxel index at that range into the second entry.
+
+#ifndef NEAREST_NEIGHBOURS_CL
+#define NEAREST_NEIGHBOURS_CL
+/// Memory offset value marking a missing region.
+#define NN_NoRegion (~(ulonglong)0u)
+
+#if GPUTIL_DEVICE == GPUTIL_OPENCL
+#define nnFloatBits(value) as_uint(value)
+#else  // GPUTIL_DEVICE == GPUTIL_OPENCL
+#define nnFloatBits(value) __float_as_uint(value)
+#endif  // GPUTIL_DEVICE == GPUTIL_OPENCL
+
+/// Evaluate the search cube voxel at @p voxel_index for the query point at @p point_index .
+/// @param[out] range_squared Set to the squared range from the query point to the voxel centre.
+/// @return True if the voxel is obstructed and within the search radius.
+inline __device__ bool nnEvaluateVoxel(uint point_index, uint voxel_index, __global float *occupancy,
+                                       __global ulonglong *region_mem_offsets, __global NearestNeighboursPoint *points,
+                                       int3 region_dimensions, int3 region_span, int cube_dim, uint voxel_order,
+                                       float voxel_resolution, float radius_squared, float occupied_threshold,
+                                       uint flags, float *range_squared)
+{
+  __global NearestNeighboursPoint *point = &points[point_index];
+  const int cx = (int)(voxel_index % (uint)cube_dim);
+  const int cy = (int)((voxel_index / (uint)cube_dim) % (uint)cube_dim);
+  const int cz = (int)(voxel_index / (uint)(cube_dim * cube_dim));
+
+  const float dx = cx * voxel_resolution - point->offset[0];
+  const float dy = cy * voxel_resolution - point->offset[1];
+  const float dz = cz * voxel_resolution - point->offset[2];
+  *range_squared = dx * dx + dy * dy + dz * dz;
+  if (*range_squared > radius_squared)
+  {
+    return false;
+  }
+
+  // Resolve the region step and local voxel. All coordinates are non-negative so plain division is safe. Components
+  // are resolved individually as CUDA has no int3 operators.
+  const int vx = point->min_voxel[0] + cx;
+  const int vy = point->min_voxel[1] + cy;
+  const int vz = point->min_voxel[2] + cz;
+  const int rx = vx / region_dimensions.x;
+  const int ry = vy / region_dimensions.y;
+  const int rz = vz / region_dimensions.z;
+
+  const uint region_volume = (uint)(region_span.x * region_span.y * region_span.z);
+  const uint region_index = (uint)(rx + ry * region_span.x + rz * region_span.x * region_span.y);
+  const ulonglong mem_offset = region_mem_offsets[point_index * region_volume + region_index];
+
+  float value = INFINITY;
+  if (mem_offset != NN_NoRegion)
+  {
+    const ulonglong vi_local =
+      orderedVoxelIndex(vx - rx * region_dimensions.x, vy - ry * region_dimensions.y, vz - rz * region_dimensions.z,
+                        region_dimensions.x, region_dimensions.y, region_dimensions.z, voxel_order);
+    value = occupancy[mem_offset / sizeof(*occupancy) + vi_local];
+  }
+
+  return (value == INFINITY) ? (flags & NN_FlagUnknownAsOccupied) != 0 : value >= occupied_threshold;
+}
+#endif  // NEAREST_NEIGHBOURS_CL
+
+
+/// Find the obstructed voxels within @p search_radius of each query point.
+///
+/// @param occupancy The occupancy cache buffer.
+/// @param region_mem_offsets Byte offsets into @p occupancy for each point's region table. There are
+///   @c region_span.x * region_span.y * region_span.z entries per point with @c NN_NoRegion for missing regions.
+/// @param points The query points.
+/// @param point_count Number of @p points .
+/// @param region_dimensions Region voxel dimensions.
+/// @param region_span Number of regions in each point's region table along each axis.
+/// @param cube_dim Number of voxels along each axis of the search cube.
+/// @param voxel_order Order of voxels in region memory: @c OHM_VOXEL_ORDER_ROW_MAJOR etc.
+/// @param voxel_resolution Voxel size.
+/// @param search_radius The search radius around each query point.
+/// @param occupied_threshold Occupancy threshold value.
+/// @param flags Query flags: @c NN_FlagUnknownAsOccupied , @c NN_FlagNearestResult .
+/// @param pass Reduction pass for @c NN_FlagNearestResult : @c NN_PassNearestRange or @c NN_PassNearestVoxel .
+/// @param results Output results when not using @c NN_FlagNearestResult .
+/// @param max_results Capacity of @p results .
+/// @param result_count Output result count. May exceed @p max_results on overflow.
+/// @param nearest Nearest result reduction: two entries per point. Only used with @c NN_FlagNearestResult .
+__kernel void nearestNeighbours(__global float *occupancy, __global ulonglong *region_mem_offsets,
+                                __global NearestNeighboursPoint *points, uint point_count, int3 region_dimensions,
+                                int3 region_span, int cube_dim, uint voxel_order, float voxel_resolution,
+                                float search_radius, float occupied_threshold, uint flags, uint pass,
+                                __global NearestNeighboursResult *results, uint max_results,
+                                __global atomic_uint *result_count, __global atomic_uint *nearest)
+{
+  const uint voxel_index = (uint)get_global_id(0);
+  const uint point_index = (uint)get_global_id(1);
+  const uint cube_volume = (uint)(cube_dim * cube_dim * cube_dim);
+  if (voxel_index >= cube_volume || point_index >= point_count)
+  {
+    return;
+  }
+
+  float range_squared = 0;
+  if (!nnEvaluateVoxel(point_index, voxel_index, occupancy, region_mem_offsets, points, region_dimensions,
+                       region_span, cube_dim, voxel_order, voxel_resolution, search_radius * search_radius,
+                       occupied_threshold, flags, &range_squared))
+  {
+    return;
+  }
+
+  if (flags & NN_FlagNearestResult)
+  {
+    const uint range_bits = nnFloatBits(range_squared);
+    if (pass == NN_PassNearestRange)
+    {
+      gputilAtomicMin(&nearest[point_index * 2u], range_bits);
+    }
+    else if (range_bits == gputilAtomicLoadU32(&nearest[point_index * 2u]))
+    {
+      gputilAtomicMin(&nearest[point_index * 2u + 1u], voxel_index);
+    }
+    return;
+  }
+
+  const uint result_index = gputilAtomicAdd(result_count, 1u);
+  if (result_index < max_results)
+  {
+    results[result_index].point_index = point_index;
+    results[result_index].voxel_index = voxel_index;
+    results[result_index].range = sqrt(range_squared);
+  }
+}
+
+/// @}
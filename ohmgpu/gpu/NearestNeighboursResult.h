@@ -0,0 +1,47 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPU_NEARESTNEIGHBOURS_RESULT_H
+#define OHMGPU_GPU_NEARESTNEIGHBOURS_RESULT_H
+
+#ifndef NN_FlagUnknownAsOccupied
+/// Kernel flag: treat unobserved voxels and missing regions as occupied.
+#define NN_FlagUnknownAsOccupied (1u << 0u)
+/// Kernel flag: resolve only the nearest voxel for each query point rather than appending all results.
+#define NN_FlagNearestResult (1u << 1u)
+#endif  // NN_FlagUnknownAsOccupied
+
+#ifndef NN_PassNearestRange
+/// Nearest result pass: reduce the minimum squared range for each query point.
+#define NN_PassNearestRange (0u)
+/// Nearest result pass: reduce the lowest search cube voxel index at the minimum range for each query point.
+#define NN_PassNearestVoxel (1u)
+#endif  // NN_PassNearestRange
+
+/// Per point input for a @c NearestNeighboursGpu query.
+///
+/// Each point searches a cube of voxels starting at the voxel containing the lower corner of the search sphere bounds,
+/// the cube min voxel.
+typedef struct NearestNeighboursPoint_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Position of the query point relative to the centre of the cube min voxel.
+  float offset[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Local voxel coordinates of the cube min voxel within the first region of the point's region table.
+  int min_voxel[3];  // NOLINT(modernize-avoid-c-arrays)
+} NearestNeighboursPoint;
+
+/// Structure used to write results for a @c NearestNeighboursGpu query: an obstructed voxel within the search radius
+/// of a query point.
+typedef struct NearestNeighboursResult_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Index of the query point.
+  unsigned point_index;
+  /// Index of the voxel in the point's search cube: x + y * cube_dim + z * cube_dim * cube_dim .
+  unsigned voxel_index;
+  /// Range from the query point to the voxel centre.
+  float range;
+} NearestNeighboursResult;
+
+#endif  // OHMGPU_GPU_NEARESTNEIGHBOURS_RESULT_H
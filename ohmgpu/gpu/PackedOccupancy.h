@@ -0,0 +1,69 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPU_PACKED_OCCUPANCY_H
+#define OHMGPU_GPU_PACKED_OCCUPANCY_H
+
+/// @defgroup packedOccupancyGpu Packed Occupancy GPU
+/// @{
+/// @brief 16-bit fixed point occupancy values for the GPU cache.
+///
+/// A @c GpuLayerCache created with @c kGcfPackedOccupancy stores the occupancy layer's log-odds values as 16-bit fixed
+/// point, halving the cache memory per region. Values are scaled by @c OHM_PACKED_OCCUPANCY_SCALE and rounded, giving
+/// a resolution of ~0.001 log-odds over a range of +/-32. The unobserved value (infinity) maps to
+/// @c OHM_PACKED_OCCUPANCY_UNOBSERVED .
+///
+/// Packed voxels are stored two per 32-bit word with the even index voxel in the low 16 bits. GPU code updates a voxel
+/// using a compare and swap on the containing word.
+///
+/// This header is shared between host and device code. Host code must include @c <cmath> first.
+
+#if !GPUTIL_DEVICE
+#ifndef __device__
+#define __device__
+#endif  // __device__
+#ifndef __host__
+#define __host__
+#endif  // __host__
+
+namespace ohm
+{
+#endif  // !GPUTIL_DEVICE
+
+/// Scale factor applied to log-odds occupancy values to convert to packed fixed point.
+#define OHM_PACKED_OCCUPANCY_SCALE 1024.0f
+/// Packed value for an unobserved voxel.
+#define OHM_PACKED_OCCUPANCY_UNOBSERVED (-32768)
+/// Maximum packed value magnitude for observed voxels.
+#define OHM_PACKED_OCCUPANCY_LIMIT 32767
+
+/// Convert a log-odds occupancy @p value to packed fixed point. Out of range values are clamped.
+/// @param value The occupancy value. Infinity marks an unobserved voxel.
+/// @return The packed value in the range [-32768, 32767].
+inline __device__ __host__ int packOccupancy(float value)
+{
+  if (value == INFINITY)
+  {
+    return OHM_PACKED_OCCUPANCY_UNOBSERVED;
+  }
+  const float scaled = (float)floor(value * OHM_PACKED_OCCUPANCY_SCALE + 0.5f);
+  return (int)fmin(fmax(scaled, (float)-OHM_PACKED_OCCUPANCY_LIMIT), (float)OHM_PACKED_OCCUPANCY_LIMIT);
+}
+
+/// Convert a @p packed fixed point occupancy value to log-odds.
+/// @param packed The packed value, sign extended.
+/// @return The occupancy value. Infinity for an unobserved voxel.
+inline __device__ __host__ float unpackOccupancy(int packed)
+{
+  return (packed != OHM_PACKED_OCCUPANCY_UNOBSERVED) ? (float)packed / OHM_PACKED_OCCUPANCY_SCALE : INFINITY;
+}
+
+#if !GPUTIL_DEVICE
+}  // namespace ohm
+#endif  // !GPUTIL_DEVICE
+
+/// @}
+
+#endif  // OHMGPU_GPU_PACKED_OCCUPANCY_H
@@ -0,0 +1,151 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpu_ext.h"  // Must be first
+
+#include "ProjectiveIntegrateParams.h"
+#include "VoxelOrderCompute.h"
+#include "VoxelTsdfCompute.h"
+
+/// @defgroup projectiveIntegrateGpu Projective Integrate GPU
+/// @{
+/// @brief GPU code used to integrate depth images by projecting voxels into the image.
+///
+/// Each GPU thread updates a single voxel of one of the regions selected by @c ohm::projectiveRegions() . The voxel
+/// centre is projected into the depth image and the voxel updated from the depth of the pixel it falls in, matching the
+/// @c ohm::ProjectiveIntegrator CPU update. Each voxel is updated by one thread, so no atomic operations are required.
+///
+/// Occupancy and TSDF data are held in the @c GpuLayerCache buffers as for other ohm GPU algorithms. The cache
+/// location of each region is given by the @c ProjectiveIntegrateRegion list.
+
+#ifndef PROJECTIVE_INTEGRATE_CL
+#define PROJECTIVE_INTEGRATE_CL
+/// Adjust the occupancy value at @p occupancy by @p adjustment , respecting saturation as
+/// @c occupancyAdjustHit() and @c occupancyAdjustMiss() do. Uninitialised voxels are INFINITY.
+inline __device__ void piAdjustOccupancy(__global float *occupancy, float adjustment,
+                                         __global const ProjectiveIntegrateParams *params)
+{
+  const float initial_value = *occupancy;
+  float new_value;
+  if (initial_value == INFINITY)
+  {
+    new_value = adjustment;
+  }
+  else if (params->saturation_min < initial_value && initial_value < params->saturation_max)
+  {
+    new_value = initial_value + adjustment;
+  }
+  else
+  {
+    return;
+  }
+  *occupancy = clamp(new_value, params->voxel_value_min, params->voxel_value_max);
+}
+
+
+/// Projective integration kernel. One thread per voxel for each region in @p regions .
+///
+/// @param occupancy The occupancy layer cache buffer. May be null without @c PI_FlagOccupancy .
+/// @param tsdf_voxels The TSDF layer cache buffer. May be null without @c PI_FlagTsdf .
+/// @param regions The regions to update.
+/// @param region_count The number of @p regions .
+/// @param params Camera and map parameters.
+/// @param depth The depth image, row major.
+__kernel void projectiveIntegrate(__global float *occupancy, __global VoxelTsdf *tsdf_voxels,
+                                  __global const ProjectiveIntegrateRegion *regions, uint region_count,
+                                  __global const ProjectiveIntegrateParams *params, __global const float *depth)
+{
+  const uint region_volume =
+    (uint)(params->region_dimensions[0] * params->region_dimensions[1] * params->region_dimensions[2]);
+  const uint thread_index = (uint)get_global_id(0);
+  const uint region_index = thread_index / region_volume;
+  if (region_index >= region_count)
+  {
+    return;
+  }
+
+  const uint voxel_index = thread_index % region_volume;
+  const uint x = voxel_index % (uint)params->region_dimensions[0];
+  const uint y = (voxel_index / (uint)params->region_dimensions[0]) % (uint)params->region_dimensions[1];
+  const uint z = voxel_index / (uint)(params->region_dimensions[0] * params->region_dimensions[1]);
+
+  // Voxel centre relative to the camera, in the map and camera frames.
+  __global const ProjectiveIntegrateRegion *region = &regions[region_index];
+  const float centre[3] = { region->region_min[0] + ((float)x + 0.5f) * params->resolution,
+                            region->region_min[1] + ((float)y + 0.5f) * params->resolution,
+                            region->region_min[2] + ((float)z + 0.5f) * params->resolution };
+  float point[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    point[i] = params->rotation[i * 3 + 0] * centre[0] + params->rotation[i * 3 + 1] * centre[1] +
+               params->rotation[i * 3 + 2] * centre[2];
+  }
+
+  if (point[2] < params->min_depth)
+  {
+    return;
+  }
+
+  // Pixel centres lie at integer image coordinates.
+  const float u = floor(params->intrinsics[0] * point[0] / point[2] + params->intrinsics[2] + 0.5f);
+  const float v = floor(params->intrinsics[1] * point[1] / point[2] + params->intrinsics[3] + 0.5f);
+  if (u < 0.0f || v < 0.0f || u >= (float)params->width || v >= (float)params->height)
+  {
+    return;
+  }
+
+  const float pixel_depth = depth[(uint)v * params->width + (uint)u];
+  if (!(pixel_depth > 0.0f) || !isfinite(pixel_depth))
+  {
+    return;
+  }
+
+  const bool clipped = pixel_depth > params->max_depth;
+  if (params->flags & PI_FlagOccupancy)
+  {
+    const float half_voxel = 0.5f * params->resolution;
+    float adjustment = 0.0f;
+    if (clipped)
+    {
+      adjustment = (point[2] <= params->max_depth) ? params->miss_value : 0.0f;
+    }
+    else if (point[2] <= pixel_depth + half_voxel)
+    {
+      adjustment = (point[2] >= pixel_depth - half_voxel) ? params->hit_value : params->miss_value;
+    }
+
+    if (adjustment != 0.0f)
+    {
+      const uint index = orderedVoxelIndex(x, y, z, params->region_dimensions[0], params->region_dimensions[1],
+                                           params->region_dimensions[2], params->occupancy_voxel_order);
+      piAdjustOccupancy(&occupancy[region->occupancy_offset + index], adjustment, params);
+    }
+  }
+
+  if ((params->flags & PI_FlagTsdf) && !clipped)
+  {
+    const float scale = pixel_depth / point[2];
+    const float range = sqrt(point[0] * point[0] + point[1] * point[1] + point[2] * point[2]);
+    if ((scale - 1.0f) * range >= -params->truncation_distance)
+    {
+      const float3 sensor = make_float3(0.0f, 0.0f, 0.0f);
+      const float3 voxel_centre = make_float3(centre[0], centre[1], centre[2]);
+      const float3 sample = make_float3(centre[0] * scale, centre[1] * scale, centre[2] * scale);
+      const uint index = orderedVoxelIndex(x, y, z, params->region_dimensions[0], params->region_dimensions[1],
+                                           params->region_dimensions[2], params->tsdf_voxel_order);
+      __global VoxelTsdf *voxel = &tsdf_voxels[region->tsdf_offset + index];
+      float weight = voxel->weight;
+      float distance = voxel->distance;
+      calculateTsdf(sensor, sample, voxel_centre, params->truncation_distance, params->max_weight,
+                    params->dropoff_epsilon, params->sparsity_compensation_factor, &weight, &distance);
+      voxel->weight = weight;
+      voxel->distance = distance;
+    }
+  }
+}
+
+#endif  // PROJECTIVE_INTEGRATE_CL
+
+/// @}
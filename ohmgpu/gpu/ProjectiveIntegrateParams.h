@@ -0,0 +1,76 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPU_PROJECTIVEINTEGRATE_PARAMS_H
+#define OHMGPU_GPU_PROJECTIVEINTEGRATE_PARAMS_H
+
+#ifndef PI_FlagOccupancy
+/// Kernel flag: update the occupancy layer.
+#define PI_FlagOccupancy (1u << 0u)
+/// Kernel flag: update the TSDF layer.
+#define PI_FlagTsdf (1u << 1u)
+#endif  // PI_FlagOccupancy
+
+/// Camera and map parameters for a @c ProjectiveIntegratorGpu update.
+///
+/// Spatial values are expressed relative to the camera position in order to preserve single precision.
+typedef struct ProjectiveIntegrateParams_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Map to camera rotation matrix, row major.
+  float rotation[9];  // NOLINT(modernize-avoid-c-arrays)
+  /// Pinhole intrinsics: (fx, fy, cx, cy).
+  float intrinsics[4];  // NOLINT(modernize-avoid-c-arrays)
+  /// Number of voxels in each region.
+  int region_dimensions[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Voxel size.
+  float resolution;
+  /// Voxels closer than this depth are not updated.
+  float min_depth;
+  /// Depths beyond this value are clipped.
+  float max_depth;
+  /// Occupancy hit adjustment.
+  float hit_value;
+  /// Occupancy miss adjustment.
+  float miss_value;
+  /// Minimum occupancy value.
+  float voxel_value_min;
+  /// Maximum occupancy value.
+  float voxel_value_max;
+  /// Occupancy values at or below this are not modified.
+  float saturation_min;
+  /// Occupancy values at or above this are not modified.
+  float saturation_max;
+  /// TSDF truncation distance.
+  float truncation_distance;
+  /// Maximum TSDF weight.
+  float max_weight;
+  /// TSDF weight dropoff. Disabled when zero or less.
+  float dropoff_epsilon;
+  /// TSDF sparsity compensation factor. Disabled when zero or less.
+  float sparsity_compensation_factor;
+  /// Order of voxels in occupancy region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
+  unsigned occupancy_voxel_order;
+  /// Order of voxels in TSDF region memory.
+  unsigned tsdf_voxel_order;
+  /// Kernel flags: @c PI_FlagOccupancy and/or @c PI_FlagTsdf .
+  unsigned flags;
+  /// Image width (pixels).
+  unsigned width;
+  /// Image height (pixels).
+  unsigned height;
+} ProjectiveIntegrateParams;
+
+/// A region to update in a @c ProjectiveIntegratorGpu update.
+typedef struct ProjectiveIntegrateRegion_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Minimum corner of the region relative to the camera position.
+  float region_min[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Index of the region's first voxel in the occupancy cache buffer: the cache byte offset over the voxel size.
+  unsigned occupancy_offset;
+  /// Index of the region's first voxel in the TSDF cache buffer: the cache byte offset over the voxel size.
+  unsigned tsdf_offset;
+} ProjectiveIntegrateRegion;
+
+#endif  // OHMGPU_GPU_PROJECTIVEINTEGRATE_PARAMS_H
@@ -0,0 +1,229 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpu_ext.h"  // Must be first
+
+#include "RangeImageParams.h"
+#include "VoxelOrderCompute.h"
+
+/// @defgroup rangeImageGpu Range Image GPU
+/// @{
+/// @brief GPU code used to synthesise range or depth images by ray casting occupancy voxels.
+///
+/// Each GPU thread casts the ray for a single pixel from the sensor origin and records the range at which it first
+/// enters an occupied voxel, or zero when there is no occupied voxel between the minimum and maximum range.
+/// Unobserved voxels do not stop the ray.
+///
+/// Empty space is skipped hierarchically. Rays first step through a dense grid of regions covering the sensor range
+/// (see @c RangeImageRegion ). Regions without occupied voxels are crossed in a single step. Otherwise the ray is
+/// clipped to the bounds of the region's occupied voxels and only the voxels within those bounds are traversed.
+///
+/// Occupancy data are held in the @c GpuLayerCache buffer as for other ohm GPU algorithms. The cache location of
+/// each region is resolved directly from the region grid rather than by searching a region key list.
+
+#ifndef RANGE_IMAGE_CL
+#define RANGE_IMAGE_CL
+/// Resolve the index of the axis with the smallest @p t value.
+inline __device__ int riMinAxis(const float *t)
+{
+  return (t[0] < t[1]) ? ((t[0] < t[2]) ? 0 : 2) : ((t[1] < t[2]) ? 1 : 2);
+}
+
+
+/// Calculate the unit ray direction in the sensor frame for pixel (@p u , @p v ).
+inline __device__ void riPixelDirection(__global const RangeImageParams *params, uint u, uint v, float *dir)
+{
+  if (params->model == RI_ModelSpherical)
+  {
+    const float azimuth = params->intrinsics[0] + ((float)u + 0.5f) * params->intrinsics[1];
+    const float elevation = params->intrinsics[2] - ((float)v + 0.5f) * params->intrinsics[3];
+    dir[0] = cos(elevation) * cos(azimuth);
+    dir[1] = cos(elevation) * sin(azimuth);
+    dir[2] = sin(elevation);
+    return;
+  }
+
+  dir[0] = ((float)u - params->intrinsics[2]) / params->intrinsics[0];
+  dir[1] = ((float)v - params->intrinsics[3]) / params->intrinsics[1];
+  dir[2] = 1.0f;
+  const float length = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+  dir[0] /= length;
+  dir[1] /= length;
+  dir[2] /= length;
+}
+
+
+/// Cast a ray through the occupied voxel bounds of a single region over the range [@p t_begin , @p t_end ).
+/// @return The range at which the ray enters an occupied voxel or a negative value if none is found.
+inline __device__ float riCastRegion(__global const float *occupancy, __global const RangeImageRegion *region,
+                                     __global const RangeImageParams *params, const int *cell, const float *origin,
+                                     const float *dir, float t_begin, float t_end)
+{
+  const float resolution = params->resolution;
+  float region_min[3];
+  int occupied_min[3];
+  int occupied_max[3];
+
+  // Clip to the occupied bounds.
+  for (int i = 0; i < 3; ++i)
+  {
+    region_min[i] = (float)cell[i] * params->region_size[i];
+    occupied_min[i] = region->occupied_min[i];
+    occupied_max[i] = region->occupied_max[i];
+    const float box_min = region_min[i] + (float)occupied_min[i] * resolution;
+    const float box_max = region_min[i] + (float)(occupied_max[i] + 1) * resolution;
+    if (dir[i] == 0.0f)
+    {
+      if (origin[i] < box_min || origin[i] > box_max)
+      {
+        return -1.0f;
+      }
+      continue;
+    }
+    const float ta = (box_min - origin[i]) / dir[i];
+    const float tb = (box_max - origin[i]) / dir[i];
+    t_begin = max(t_begin, min(ta, tb));
+    t_end = min(t_end, max(ta, tb));
+  }
+
+  if (t_begin >= t_end)
+  {
+    return -1.0f;
+  }
+
+  // Voxel traversal within the bounds.
+  int voxel[3];
+  int step[3];
+  float t_max[3];
+  float t_delta[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    const float local = origin[i] + dir[i] * t_begin - region_min[i];
+    voxel[i] = clamp((int)floor(local / resolution), occupied_min[i], occupied_max[i]);
+    step[i] = (dir[i] > 0.0f) ? 1 : ((dir[i] < 0.0f) ? -1 : 0);
+    t_max[i] = (step[i]) ?
+                 (region_min[i] + (float)(voxel[i] + ((step[i] > 0) ? 1 : 0)) * resolution - origin[i]) / dir[i] :
+                 INFINITY;
+    t_delta[i] = (step[i]) ? resolution / fabs(dir[i]) : INFINITY;
+  }
+
+  const uint voxel_offset = region->voxel_offset;
+  float t = t_begin;
+  while (t < t_end)
+  {
+    const uint voxel_index =
+      orderedVoxelIndex(voxel[0], voxel[1], voxel[2], params->region_dimensions[0], params->region_dimensions[1],
+                        params->region_dimensions[2], params->voxel_order);
+    const float value = occupancy[voxel_offset + voxel_index];
+    if (value != INFINITY && value >= params->occupied_threshold)
+    {
+      return t;
+    }
+
+    const int axis = riMinAxis(t_max);
+    voxel[axis] += step[axis];
+    if (voxel[axis] < occupied_min[axis] || voxel[axis] > occupied_max[axis])
+    {
+      break;
+    }
+    t = t_max[axis];
+    t_max[axis] += t_delta[axis];
+  }
+
+  return -1.0f;
+}
+
+
+/// Cast a ray through the region grid.
+/// @return The range at which the ray enters an occupied voxel or zero if none is found.
+inline __device__ float riCastRay(__global const float *occupancy, __global const RangeImageRegion *regions,
+                                  __global const RangeImageParams *params, const float *origin, const float *dir)
+{
+  int cell[3];
+  int step[3];
+  float t_max[3];
+  float t_delta[3];
+  float t = params->min_range;
+  const float t_end = params->max_range;
+
+  for (int i = 0; i < 3; ++i)
+  {
+    const float region_size = params->region_size[i];
+    cell[i] = (int)floor((origin[i] + dir[i] * t) / region_size);
+    step[i] = (dir[i] > 0.0f) ? 1 : ((dir[i] < 0.0f) ? -1 : 0);
+    t_max[i] =
+      (step[i]) ? ((float)(cell[i] + ((step[i] > 0) ? 1 : 0)) * region_size - origin[i]) / dir[i] : INFINITY;
+    t_delta[i] = (step[i]) ? region_size / fabs(dir[i]) : INFINITY;
+  }
+
+  while (t < t_end)
+  {
+    const float t_exit = min(min(t_max[0], t_max[1]), min(t_max[2], t_end));
+    if (cell[0] >= 0 && cell[1] >= 0 && cell[2] >= 0 && cell[0] < params->grid_dimensions[0] &&
+        cell[1] < params->grid_dimensions[1] && cell[2] < params->grid_dimensions[2])
+    {
+      __global const RangeImageRegion *region =
+        &regions[cell[0] + params->grid_dimensions[0] * (cell[1] + params->grid_dimensions[1] * cell[2])];
+      // Empty regions are skipped without touching voxel memory.
+      if (region->occupied_min[0] <= region->occupied_max[0])
+      {
+        const float hit = riCastRegion(occupancy, region, params, cell, origin, dir, t, t_exit);
+        if (hit >= 0.0f)
+        {
+          return hit;
+        }
+      }
+    }
+
+    const int axis = riMinAxis(t_max);
+    cell[axis] += step[axis];
+    t = t_max[axis];
+    t_max[axis] += t_delta[axis];
+  }
+
+  return 0.0f;
+}
+#endif  // RANGE_IMAGE_CL
+
+
+/// Synthesise a range image. Invoked with one thread per pixel over a two dimensional global size matching the
+/// image dimensions.
+///
+/// @param occupancy The @c GpuLayerCache occupancy buffer.
+/// @param regions The dense region grid, @c RangeImageParams::grid_dimensions in size with X varying fastest.
+/// @param params The sensor and map parameters.
+/// @param ranges The output image in row major order. Each pixel is the range to the first occupied voxel or zero
+///   when there is no return. The depth is written instead of the range with @c RI_FlagDepth .
+__kernel void rangeImage(__global const float *occupancy, __global const RangeImageRegion *regions,
+                         __global const RangeImageParams *params, __global float *ranges)
+{
+  const uint u = (uint)get_global_id(0);
+  const uint v = (uint)get_global_id(1);
+  if (u >= params->width || v >= params->height)
+  {
+    return;
+  }
+
+  float sensor_dir[3];
+  float dir[3];
+  float origin[3];
+  riPixelDirection(params, u, v, sensor_dir);
+  for (int i = 0; i < 3; ++i)
+  {
+    dir[i] = params->rotation[i * 3 + 0] * sensor_dir[0] + params->rotation[i * 3 + 1] * sensor_dir[1] +
+             params->rotation[i * 3 + 2] * sensor_dir[2];
+    origin[i] = params->origin[i];
+  }
+
+  float range = riCastRay(occupancy, regions, params, origin, dir);
+  if ((params->flags & RI_FlagDepth) && params->model == RI_ModelPinhole)
+  {
+    range *= sensor_dir[2];
+  }
+
+  ranges[v * params->width + u] = range;
+}
+
+/// @}
@@ -0,0 +1,72 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPU_RANGEIMAGE_PARAMS_H
+#define OHMGPU_GPU_RANGEIMAGE_PARAMS_H
+
+#ifndef RI_ModelPinhole
+/// Pinhole camera model: x right, y down, z forward.
+#define RI_ModelPinhole (0)
+/// Spherical (lidar) model: x forward, y left, z up. Columns sweep the azimuth, rows sweep the elevation from the top.
+#define RI_ModelSpherical (1)
+#endif  // RI_ModelPinhole
+
+#ifndef RI_FlagDepth
+/// Kernel flag: write the depth along the pinhole camera axis rather than the range along each ray.
+#define RI_FlagDepth (1u << 0u)
+#endif  // RI_FlagDepth
+
+/// Sensor and map parameters for a @c RangeImageGpu render.
+///
+/// Spatial values are expressed relative to the minimum corner of the region grid in order to preserve single
+/// precision.
+typedef struct RangeImageParams_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Sensor to map rotation matrix, row major.
+  float rotation[9];  // NOLINT(modernize-avoid-c-arrays)
+  /// Sensor position relative to the region grid origin.
+  float origin[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Pinhole: (fx, fy, cx, cy). Spherical: (min azimuth, azimuth step, max elevation, elevation step) radians.
+  float intrinsics[4];  // NOLINT(modernize-avoid-c-arrays)
+  /// Spatial size of a region.
+  float region_size[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Number of voxels in each region.
+  int region_dimensions[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Number of regions along each axis of the region grid.
+  int grid_dimensions[3];  // NOLINT(modernize-avoid-c-arrays)
+  /// Voxel size.
+  float resolution;
+  /// Minimum occupancy value for an occupied voxel.
+  float occupied_threshold;
+  /// Rays start at this range.
+  float min_range;
+  /// Rays end at this range.
+  float max_range;
+  /// Order of voxels in region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
+  unsigned voxel_order;
+  /// @c RI_ModelPinhole or @c RI_ModelSpherical .
+  int model;
+  /// Kernel flags, such as @c RI_FlagDepth .
+  unsigned flags;
+  /// Image width (pixels).
+  unsigned width;
+  /// Image height (pixels).
+  unsigned height;
+} RangeImageParams;
+
+/// An entry in the dense region grid for a @c RangeImageGpu render. Regions without occupied voxels - including
+/// regions which do not exist - are marked empty, with @c occupied_min exceeding @c occupied_max , and are skipped
+/// without touching voxel memory.
+typedef struct RangeImageRegion_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Index of the region's first voxel in the occupancy cache buffer: the cache byte offset over the voxel size.
+  unsigned voxel_offset;
+  /// Minimum local key of the region's occupied voxels. The last element is padding.
+  unsigned char occupied_min[4];  // NOLINT(modernize-avoid-c-arrays)
+  /// Maximum local key of the region's occupied voxels, inclusive. The last element is padding.
+  unsigned char occupied_max[4];  // NOLINT(modernize-avoid-c-arrays)
+} RangeImageRegion;
+
+#endif  // OHMGPU_GPU_RANGEIMAGE_PARAMS_H
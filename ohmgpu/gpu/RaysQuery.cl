@@ -32,6 +32,7 @@
 #include "MapCoord.h"
 #include "RayFlag.h"
 #include "RaysQueryResult.h"
+#include "VoxelOrderCompute.h"
 
 #include "LineWalkMarkers.cl"
 #include "Regions.cl"
@@ -56,6 +57,8 @@ typedef struct LineWalkData_t
   int3 current_region;
   // Size of a region in voxels.
   int3 region_dimensions;
+  /// Order of voxels in region memory: OHM_VOXEL_ORDER_ROW_MAJOR, OHM_VOXEL_ORDER_MORTON or OHM_VOXEL_ORDER_BRICK4.
+  uint voxel_order;
   /// Value threshold for occupied voxels.
   float occupied_threshold;
   // Number of regions in region_keys/region_mem_offsets.
@@ -93,8 +96,9 @@ __device__ bool visitVoxelRayQuery(const GpuKey *voxel_key, const GpuKey *start_
 
   // This voxel lies in the region. We will make a value adjustment.
   // Work out which voxel to modify.
-  const ulonglong vi_local = voxel_key->voxel[0] + voxel_key->voxel[1] * line_data->region_dimensions.x +
-                             voxel_key->voxel[2] * line_data->region_dimensions.x * line_data->region_dimensions.y;
+  const ulonglong vi_local =
+    orderedVoxelIndex(voxel_key->voxel[0], voxel_key->voxel[1], voxel_key->voxel[2], line_data->region_dimensions.x,
+                      line_data->region_dimensions.y, line_data->region_dimensions.z, line_data->voxel_order);
   const ulonglong vi =
     (line_data->occupancy_offsets[line_data->current_region_index] / sizeof(*line_data->occupancy)) + vi_local;
 
@@ -182,6 +186,7 @@ __device__ bool visitVoxelRayQuery(const GpuKey *voxel_key, const GpuKey *start_
 /// @param line_count number of lines in @p line_keys and @p local_lines. These come in pairs, so the number of elements
 ///     in those arrays is double this value.
 /// @param region_dimensions Specifies the size of any one region in voxels.
+/// @param voxel_order Specifies the order of voxels in region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 /// @param voxel_resolution Specifies the size of a voxel cube.
 /// @param ray_adjustment Specifies the value adjustment to apply to voxels along the line segment leading up to the
 ///     final sample voxel. This should be < 0 to re-enforce as free.
@@ -192,8 +197,8 @@ __device__ bool visitVoxelRayQuery(const GpuKey *voxel_key, const GpuKey *start_
 /// @param region_update_flags Update control values as per @c RayFlag.
 __kernel void raysQuery(__global atomic_float *occupancy, __global ulonglong *occupancy_region_mem_offsets_global,
                         __global int3 *occupancy_region_keys_global, uint region_count, __global GpuKey *line_keys,
-                        __global float3 *local_lines, uint line_count, int3 region_dimensions, float voxel_resolution,
-                        float occupied_threshold, float volume_coefficient,
+                        __global float3 *local_lines, uint line_count, int3 region_dimensions, uint voxel_order,
+                        float voxel_resolution, float occupied_threshold, float volume_coefficient,
                         // Output buffers.
                         __global RaysQueryResult *results)
 {
@@ -208,6 +213,7 @@ __kernel void raysQuery(__global atomic_float *occupancy, __global ulonglong *oc
   line_data.occupancy_offsets = occupancy_region_mem_offsets_global;
   line_data.region_keys = occupancy_region_keys_global;
   line_data.region_dimensions = region_dimensions;
+  line_data.voxel_order = voxel_order;
   line_data.occupied_threshold = occupied_threshold;
   line_data.region_count = region_count;
   line_data.volume_coefficient = volume_coefficient;
@@ -231,6 +237,50 @@ __kernel void raysQuery(__global atomic_float *occupancy, __global ulonglong *oc
   results[get_global_id(0)] = line_data.result;
 }
 
+/// Reduce the @c raysQuery() results for contiguous groups of rays. Each work item reduces one group.
+///
+/// @param results The per ray results from @c raysQuery() .
+/// @param result_count Number of items in @p results .
+/// @param group_size Number of rays in each group. The last group may be smaller.
+/// @param reduce_flags The reductions to calculate - @c RQ_ReduceSum , @c RQ_ReduceMin and/or
+///     @c RQ_ReduceAnyOccupied .
+/// @param reductions Output array with one item per group.
+__kernel void raysQueryReduce(__global const RaysQueryResult *results, uint result_count, uint group_size,
+                              uint reduce_flags, __global RaysQueryReduceResult *reductions)
+{
+  const uint group_count = (result_count + group_size - 1) / group_size;
+  if (get_global_id(0) >= group_count)
+  {
+    return;
+  }
+
+  const uint begin = (uint)get_global_id(0) * group_size;
+  const uint end = min(begin + group_size, result_count);
+
+  RaysQueryReduceResult reduction;
+  reduction.unobserved_volume = 0;
+  reduction.min_range = (begin < end && (reduce_flags & RQ_ReduceMin)) ? results[begin].range : 0;
+  reduction.occupied_count = 0;
+
+  for (uint i = begin; i < end; ++i)
+  {
+    if (reduce_flags & RQ_ReduceSum)
+    {
+      reduction.unobserved_volume += results[i].unobserved_volume;
+    }
+    if (reduce_flags & RQ_ReduceMin)
+    {
+      reduction.min_range = min(reduction.min_range, results[i].range);
+    }
+    if ((reduce_flags & RQ_ReduceAnyOccupied) && results[i].voxel_type == RQ_OccOccupied)
+    {
+      ++reduction.occupied_count;
+    }
+  }
+
+  reductions[get_global_id(0)] = reduction;
+}
+
 #ifndef RAY_QUERY_BASE_CL
 #define RAY_QUERY_BASE_CL
 #endif  // RAY_QUERY_BASE_CL
@@ -11,3 +11,4 @@
 #include "RaysQuery.cl"
 
 GPUTIL_CUDA_DEFINE_KERNEL(raysQuery);
+GPUTIL_CUDA_DEFINE_KERNEL(raysQueryReduce);
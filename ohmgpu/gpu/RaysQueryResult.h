@@ -18,6 +18,15 @@
 #define RQ_OccOccupied (1)
 #endif  // RQ_OccNull
 
+#ifndef RQ_ReduceSum
+/// Reduction flag: sum the @c RaysQueryResult::unobserved_volume into @c RaysQueryReduceResult::unobserved_volume .
+#define RQ_ReduceSum (1u << 0u)
+/// Reduction flag: the minimum @c RaysQueryResult::range into @c RaysQueryReduceResult::min_range .
+#define RQ_ReduceMin (1u << 1u)
+/// Reduction flag: count the rays terminating in occupied voxels into @c RaysQueryReduceResult::occupied_count .
+#define RQ_ReduceAnyOccupied (1u << 2u)
+#endif  // RQ_ReduceSum
+
 /// Structure used to write results for a GpuRayQuery.
 typedef struct RaysQueryResult_t  // NOLINT(readability-identifier-naming, modernize-use-using)
 {
@@ -29,4 +38,17 @@ typedef struct RaysQueryResult_t  // NOLINT(readability-identifier-naming, moder
   int voxel_type;
 } RaysQueryResult;
 
+/// Structure used to write reduced results for a group of rays in a GpuRayQuery. Fields for reductions which are not
+/// requested are zero.
+typedef struct RaysQueryReduceResult_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Sum of the unobserved volume for the rays in the group (@c RQ_ReduceSum ).
+  float unobserved_volume;
+  /// Minimum range of the rays in the group (@c RQ_ReduceMin ).
+  float min_range;
+  /// Number of rays in the group terminating in an occupied voxel (@c RQ_ReduceAnyOccupied ). Non-zero when any ray
+  /// is blocked.
+  int occupied_count;
+} RaysQueryReduceResult;
+
 #endif  // OHMGPU_GPU_RAYQUERY_RESULT_H
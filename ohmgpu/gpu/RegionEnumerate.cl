@@ -0,0 +1,68 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+#define GPUTIL_ATOMICS_64 1
+#include "gpu_ext.h"  // Must be first
+
+#include "GpuKey.h"
+#include "RegionWalk.cl"
+
+/// Enumerate the unique set of regions touched by a @c GpuMap ray batch.
+///
+/// Each thread walks the regions of one ray, inserting the region keys into @p region_set and appending the keys
+/// which were not already present to @p regions . This is the device equivalent of calling @c gpumap::walkRegions()
+/// for each ray in the batch.
+///
+/// @param line_keys Ray start/end key pairs as uploaded for the region update.
+/// @param local_lines Ray start/end points relative to the end voxel centre.
+/// @param ray_count Number of rays in @p line_keys and @p local_lines .
+/// @param region_dim Region voxel dimensions.
+/// @param voxel_resolution Voxel size.
+/// @param region_set Zero initialised hash set used to deduplicate region keys.
+/// @param region_set_capacity Number of entries in @p region_set . Must be a power of 2.
+/// @param regions Output region keys.
+/// @param max_regions Capacity of @p regions .
+/// @param region_count Output region count. May exceed @p max_regions on overflow.
+__kernel void regionEnumerate(__global GpuKey *line_keys, __global float3 *local_lines, uint ray_count,
+                              int3 region_dim, float voxel_resolution, __global ulonglong *region_set,
+                              uint region_set_capacity, __global GpuKey *regions, uint max_regions,
+                              __global atomic_uint *region_count)
+{
+  const uint ray_index = (uint)get_global_id(0);
+  if (ray_index >= ray_count)
+  {
+    return;
+  }
+
+  GpuKey start_key;
+  GpuKey end_key;
+  copyKey(&start_key, &line_keys[ray_index * 2 + 0]);
+  copyKey(&end_key, &line_keys[ray_index * 2 + 1]);
+
+  // Convert the ray into region units relative to the minimum corner of the end region.
+  const float3 end_voxel = make_float3(end_key.voxel[0] + 0.5f, end_key.voxel[1] + 0.5f, end_key.voxel[2] + 0.5f);
+  const float3 start_coord = local_lines[ray_index * 2 + 0] / voxel_resolution + end_voxel;
+  const float3 end_coord = local_lines[ray_index * 2 + 1] / voxel_resolution + end_voxel;
+  const float3 start_region_coord = make_float3(start_coord.x / (float)region_dim.x,
+                                                start_coord.y / (float)region_dim.y,
+                                                start_coord.z / (float)region_dim.z);
+  const float3 end_region_coord = make_float3(end_coord.x / (float)region_dim.x, end_coord.y / (float)region_dim.y,
+                                              end_coord.z / (float)region_dim.z);
+  const int3 end_region = make_int3(end_key.region[0], end_key.region[1], end_key.region[2]);
+
+  regionWalkAppend(start_region_coord, end_region_coord, end_region, region_set, region_set_capacity, regions,
+                   max_regions, region_count);
+
+  // The start key was resolved in double precision on CPU. Make sure its region is included should single precision
+  // place the start point across a region boundary.
+  if (start_key.region[0] != end_region.x + (int)floor(start_region_coord.x) ||
+      start_key.region[1] != end_region.y + (int)floor(start_region_coord.y) ||
+      start_key.region[2] != end_region.z + (int)floor(start_region_coord.z))
+  {
+    regionWalkAppendKey(start_key.region[0], start_key.region[1], start_key.region[2], region_set,
+                        region_set_capacity, regions, max_regions, region_count);
+  }
+}
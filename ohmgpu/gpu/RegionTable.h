@@ -0,0 +1,94 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPU_REGION_TABLE_H
+#define OHMGPU_GPU_REGION_TABLE_H
+
+/// @defgroup regionTableGpu Region Table GPU
+/// @{
+/// @brief Device resident hash table mapping region keys to @c GpuLayerCache slots.
+///
+/// The table is an open addressing hash table with linear probing and a power of two capacity. It is maintained on
+/// host by the @c GpuLayerCache as regions enter and leave the cache and uploaded on demand - see
+/// @c GpuLayerCache::syncRegionTable() . Kernels may then resolve the cache memory for any resident region without a
+/// per batch region list. The capacity is at least twice the number of cache slots, so the table is never more than
+/// half full and probe sequences stay short.
+///
+/// The slot for a region is its index in the cache buffer: the region's voxels start at byte offset
+/// `slot * GpuLayerCache::chunkSize()` or equivalently at voxel index `slot * region_voxel_volume` .
+///
+/// This header is shared between host and device code.
+
+#if !GPUTIL_DEVICE
+#ifndef __device__
+#define __device__
+#endif  // __device__
+#ifndef __host__
+#define __host__
+#endif  // __host__
+
+namespace ohm
+{
+#endif  // !GPUTIL_DEVICE
+/// An entry in the region table.
+typedef struct RegionTableEntry_t  // NOLINT(readability-identifier-naming, modernize-use-using)
+{
+  /// Region key.
+  short region[3];  // NOLINT(modernize-avoid-c-arrays, google-runtime-int)
+  /// Non-zero when the entry is in use.
+  short used;  // NOLINT(google-runtime-int)
+  /// Cache slot holding the region.
+  unsigned slot;
+} RegionTableEntry;
+
+/// Hash a region key for the region table. The table index is this value masked by the table capacity minus one.
+inline __device__ __host__ unsigned regionTableHash(int x, int y, int z)
+{
+  // NOLINTNEXTLINE(readability-magic-numbers)
+  return ((unsigned)x * 73856093u) ^ ((unsigned)y * 19349663u) ^ ((unsigned)z * 83492791u);
+}
+#if !GPUTIL_DEVICE
+}  // namespace ohm
+#endif  // !GPUTIL_DEVICE
+
+#ifdef GPUTIL_DEVICE
+/// Lookup the cache slot for the region at (@p x , @p y , @p z ) in the region @p table .
+/// @param table The region table.
+/// @param capacity The table capacity - a power of two.
+/// @param x The region key X coordinate.
+/// @param y The region key Y coordinate.
+/// @param z The region key Z coordinate.
+/// @param[out] slot Set to the region's cache slot on success.
+/// @return True if the region is in the cache.
+inline __device__ bool regionTableLookup(__global const RegionTableEntry *table, uint capacity, int x, int y, int z,
+                                         uint *slot)
+{
+  const uint mask = capacity - 1u;
+  uint index = regionTableHash(x, y, z) & mask;
+  for (uint probe = 0; probe < capacity; ++probe)
+  {
+    // Read members explicitly rather than copying the structure. See copyKey() in GpuKey.h.
+    if (!table[index].used)
+    {
+      // Empty entry terminates the probe sequence. Not found.
+      return false;
+    }
+
+    if (table[index].region[0] == x && table[index].region[1] == y && table[index].region[2] == z)
+    {
+      *slot = table[index].slot;
+      return true;
+    }
+
+    index = (index + 1u) & mask;
+  }
+
+  return false;
+}
+#endif  // GPUTIL_DEVICE
+
+/// @}
+
+#endif  // OHMGPU_GPU_REGION_TABLE_H
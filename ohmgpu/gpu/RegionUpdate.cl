@@ -14,6 +14,11 @@
 // - REGION_UPDATE_KERNEL : the kernel name for the entry point
 // - REGION_UPDATE_SUFFIX : suffix applied to distinguish potentially repeaded
 //  code and types.
+//
+// Defining OCCUPANCY_PACKED builds the occupancy kernels for 16-bit packed occupancy voxels. See PackedOccupancy.h.
+//
+// Defining TSDF_FUSED builds regionRayUpdateOccupancyTsdf, which also updates the TSDF layer in the same traversal.
+// See GpuOccupancyTsdfMap.
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
@@ -31,22 +36,52 @@
 #define LIMIT_VOXEL_WRITE_ITERATIONS
 #endif  // LIMIT_VOXEL_WRITE_ITERATIONS
 
+// Number of spans each region is divided into for dirty tracking. Must match GpuLayerCache::kDirtySpanCount.
+#ifndef DIRTY_SPAN_COUNT
+#define DIRTY_SPAN_COUNT 32
+#endif  // DIRTY_SPAN_COUNT
+
+// Log2 of the number of slots in the work group voxel aggregation table used by regionRayUpdateOccupancyAggregate.
+// Must match GpuMapDetail::kAggregateSlotBits.
+#ifndef REGION_AGGREGATE_SLOT_BITS
+#define REGION_AGGREGATE_SLOT_BITS 9
+#endif  // REGION_AGGREGATE_SLOT_BITS
+#define REGION_AGGREGATE_SLOTS (1u << REGION_AGGREGATE_SLOT_BITS)
+// Number of linear probes made to find an aggregation slot before falling back to a direct voxel update.
+#ifndef REGION_AGGREGATE_PROBES
+#define REGION_AGGREGATE_PROBES 8
+#endif  // REGION_AGGREGATE_PROBES
+// Marks an unused aggregation slot.
+#define REGION_AGGREGATE_EMPTY 0xffffffffu
+
 //------------------------------------------------------------------------------
 // Includes
 //------------------------------------------------------------------------------
+#ifdef TSDF_FUSED
+// TSDF voxels are updated using 64-bit atomics.
+#define GPUTIL_ATOMICS_64 1
+#endif  // TSDF_FUSED
 #include "gpu_ext.h"  // Must be first
 
 #include "MapCoord.h"
+#include "PackedOccupancy.h"
 #include "RayFlag.h"
 #include "Traversal.cl"
 #include "VoxelIncident.cl"
 #include "VoxelMeanCompute.h"
+#include "VoxelOrderCompute.h"
 #ifdef NDT
 #include "CovarianceVoxelCompute.h"
 #endif  // NDT
+#ifdef TSDF_FUSED
+#include "VoxelTsdfCompute.h"
+#endif  // TSDF_FUSED
 
 #include "LineWalkMarkers.cl"
 #include "Regions.cl"
+#ifdef TSDF_FUSED
+#include "TsdfVoxel.cl"
+#endif  // TSDF_FUSED
 
 //------------------------------------------------------------------------------
 // Declarations
@@ -55,26 +90,62 @@
 // This is begging for a refactor.
 #ifdef NDT
 #define REGION_UPDATE_KERNEL regionRayUpdateNdt
+#define REGION_WALK_RAY      walkRayNdt
 #define REGION_WALK_VOXELS   walkVoxelsNdt
 #define REGION_VISIT_VOXEL   visitVoxelNdt
 #define WALK_VISIT_VOXEL     visitVoxelNdt
 #define WALK_NAME            Ndt
 
+#elif defined(TSDF_FUSED)
+#ifdef OCCUPANCY_PACKED
+#error "OCCUPANCY_PACKED is not supported for TSDF_FUSED"
+#endif  // OCCUPANCY_PACKED
+#define REGION_UPDATE_KERNEL     regionRayUpdateOccupancyTsdf
+#define REGION_WALK_RAY          walkRayOccupancyTsdf
+#define REGION_WALK_VOXELS       walkVoxelsOccupancyTsdf
+#define REGION_VISIT_VOXEL       visitVoxelOccupancy
+#define REGION_FUSED_VISIT_VOXEL visitVoxelOccupancyTsdf
+#define WALK_VISIT_VOXEL         visitVoxelOccupancyTsdf
+#define WALK_NAME                OccupancyTsdf
+
+#elif defined(OCCUPANCY_PACKED)
+#define REGION_UPDATE_KERNEL           regionRayUpdateOccupancyPacked
+#define REGION_UPDATE_AGGREGATE_KERNEL regionRayUpdateOccupancyAggregatePacked
+#define REGION_WALK_RAY                walkRayOccupancy
+#define REGION_WALK_VOXELS             walkVoxelsOccupancy
+#define REGION_VISIT_VOXEL             visitVoxelOccupancy
+#define WALK_VISIT_VOXEL               visitVoxelOccupancy
+#define WALK_NAME                      Occupancy
+
 #else  // NDT
-#define REGION_UPDATE_KERNEL regionRayUpdateOccupancy
+#define REGION_UPDATE_KERNEL           regionRayUpdateOccupancy
+#define REGION_UPDATE_AGGREGATE_KERNEL regionRayUpdateOccupancyAggregate
+#define REGION_WALK_RAY      walkRayOccupancy
 #define REGION_WALK_VOXELS   walkVoxelsOccupancy
 #define REGION_VISIT_VOXEL   visitVoxelOccupancy
 #define WALK_VISIT_VOXEL     visitVoxelOccupancy
 #define WALK_NAME            Occupancy
 #endif  // NDT
 
+#ifdef OCCUPANCY_PACKED
+#ifdef NDT
+#error "OCCUPANCY_PACKED is not supported for NDT"
+#endif  // NDT
+// Occupancy memory is accessed as 32-bit words, each holding two packed voxels.
+#define OCCUPANCY_MEM_TYPE   atomic_uint
+#define OCCUPANCY_VOXEL_SIZE 2
+#else  // OCCUPANCY_PACKED
+#define OCCUPANCY_MEM_TYPE   atomic_float
+#define OCCUPANCY_VOXEL_SIZE 4
+#endif  // OCCUPANCY_PACKED
+
 
 #ifndef REGION_UPDATE_BASE_CL
 // User data for voxel visit callback.
 typedef struct LineWalkData_t
 {
-  // Voxel occupancy memory. All regions use a shared buffer.
-  __global atomic_float *occupancy;
+  // Voxel occupancy memory. All regions use a shared buffer. Packed occupancy holds two voxels per item.
+  __global OCCUPANCY_MEM_TYPE *occupancy;
   // Array of offsets for each regionKey into occupancy. These are byte offsets.
   __global ulonglong *occupancy_offsets;
   __global VoxelMean *means;
@@ -92,6 +163,8 @@ typedef struct LineWalkData_t
   __global atomic_uint *incidents;
   // Array of offsets for each regionKey into incidents. These are byte offsets.
   __global ulonglong *incidents_offsets;
+  // Optional dirty span bit masks, one per region in region_keys. See DIRTY_SPAN_COUNT.
+  __global atomic_uint *dirty_spans;
 #ifdef NDT
   __global CovarianceVoxel *cov_voxels;
   // Array of offsets for each regionKey into cov_voxels. These are byte offsets.
@@ -107,6 +180,8 @@ typedef struct LineWalkData_t
   int3 current_region;
   // Size of a region in voxels.
   int3 region_dimensions;
+  /// Order of voxels in region memory: OHM_VOXEL_ORDER_ROW_MAJOR, OHM_VOXEL_ORDER_MORTON or OHM_VOXEL_ORDER_BRICK4.
+  uint voxel_order;
   /// Voxel size
   float voxel_resolution;
   // MapMode/voxel value adjustment for keys along the line segment, but not the sample voxel.
@@ -131,12 +206,51 @@ typedef struct LineWalkData_t
   float3 sensor;
   /// Encoded touch time value for this voxel.
   uint touch_time;
+  /// Work group local voxel aggregation table keys: REGION_AGGREGATE_SLOTS entries. Null to disable aggregation.
+  /// Each key is the region index (into region_keys) multiplied by the region volume plus the region local voxel index.
+  __local atomic_uint *aggregate_keys;
+  /// Aggregated occupancy adjustment and traversal pairs for each aggregate_keys entry.
+  __local atomic_float *aggregate_values;
+  /// The sample voxel visit deferred until the aggregation table has been written. See defer_sample.
+  GpuKey deferred_key;
+  /// Line walk marker for deferred_key.
+  int deferred_marker;
+  /// Range at which the line enters deferred_key.
+  float deferred_enter_range;
+  /// Range at which the line exits deferred_key.
+  float deferred_exit_range;
+  /// Defer visiting the sample voxel, recording the visit in the deferred_xxx members?
+  bool defer_sample;
+  /// Is there a deferred sample voxel visit?
+  bool has_deferred;
 #ifdef NDT
   // Affects how quickly NDT removes voxels: [0, 1].
   float adaptation_rate;
   // An estimate on the sensor range noise error.
   float sensor_noise;
 #endif  // NDT
+#ifdef TSDF_FUSED
+  // TSDF voxel memory. All regions use a shared buffer.
+  __global VoxelTsdf *tsdf_voxels;
+  // Array of offsets for each regionKey into tsdf_voxels. These are byte offsets.
+  __global ulonglong *tsdf_offsets;
+  /// Maximum TSDF voxel weight.
+  float tsdf_max_weight;
+  /// Default TSDF truncation distance
+  float tsdf_default_truncation_distance;
+  /// Non-zero/+ve to enable voxel dropoff.
+  float tsdf_dropoff_epsilon;
+  /// Non-zero/+ve to enable sparsity compensation.
+  float tsdf_sparsity_compensation_factor;
+  /// The unclipped sensor position in a frame local to the centre of the @c tsdf_key voxel.
+  float3 tsdf_sensor;
+  /// The unclipped sample position in a frame local to the centre of the @c tsdf_key voxel.
+  float3 tsdf_sample;
+  /// The ray end key: the voxel @c tsdf_sensor and @c tsdf_sample are relative to.
+  GpuKey tsdf_key;
+  /// Cleared once the occupancy visit stops the traversal. The TSDF update continues for the whole ray.
+  bool occupancy_active;
+#endif  // TSDF_FUSED
 } LineWalkData;
 #endif  // REGION_UPDATE_BASE_CL
 
@@ -148,8 +262,245 @@ typedef struct LineWalkData_t
 #include "AdjustOccupancy.cl"
 #endif  // NDT
 
+#ifndef REGION_UPDATE_BASE_CL
+/// Mark the dirty span containing voxel @p vi_local in the region at @p region_index as modified.
+inline __device__ void regionMarkDirtySpan(LineWalkData *line_data, uint region_index, ulonglong vi_local)
+{
+  const uint region_volume =
+    line_data->region_dimensions.x * line_data->region_dimensions.y * line_data->region_dimensions.z;
+  const uint span_voxels = (region_volume + DIRTY_SPAN_COUNT - 1) / DIRTY_SPAN_COUNT;
+  // Cast from atomic_uint to uint for OpenCL 2.0 compatibility as for atomic_max below.
+  gputilAtomicOr((__global uint *)&line_data->dirty_spans[region_index], 1u << (uint)(vi_local / span_voxels));
+}
+
+
+/// Apply @p adjustment to the occupancy voxel at index @p vi using a compare and swap loop. The result is clamped
+/// to the voxel value range and voxels are skipped as required by the exclusion @c RayFlag values.
+/// @param occupancy The occupancy voxel memory.
+/// @param vi Index of the voxel to adjust in @p occupancy , in voxels.
+/// @param adjustment The value adjustment to make.
+/// @param line_data Line walk data.
+/// @param[out] was_occupied_voxel Set to true if the voxel was occupied before the adjustment.
+/// @return The adjustment made. Zero when the voxel was skipped.
+inline __device__ float regionAdjustOccupancy(__global OCCUPANCY_MEM_TYPE *occupancy, ulonglong vi, float adjustment,
+                                              LineWalkData *line_data, bool *was_occupied_voxel)
+{
+  float old_value, new_value;
+#ifdef OCCUPANCY_PACKED
+  // Update the voxel's half of the containing word.
+  __global atomic_uint *word_ptr = &occupancy[vi / 2];
+  const uint shift = (uint)(vi % 2) * 16u;
+  uint old_word, new_word;
+#else   // OCCUPANCY_PACKED
+  __global atomic_float *occupancy_ptr = &occupancy[vi];
+#endif  // OCCUPANCY_PACKED
+#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
+  // Under high contension we can end up repeatedly failing to write the voxel value.
+  // The primary concern is not deadlocking the GPU, so we put a hard limit on the numebr of
+  // attempts made.
+  const int iteration_limit = 20;
+  int iterations = 0;
+#endif
+  do
+  {
+#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
+    if (iterations++ > iteration_limit)
+    {
+      break;
+    }
+#endif
+    // Calculate a new value for the voxel.
+#ifdef OCCUPANCY_PACKED
+    old_word = gputilAtomicLoadU32(word_ptr);
+    // Sign extend the packed value.
+    old_value = new_value = unpackOccupancy((int)(short)((old_word >> shift) & 0xffffu));
+#else   // OCCUPANCY_PACKED
+    old_value = new_value = gputilAtomicLoadF32(occupancy_ptr);
+#endif  // OCCUPANCY_PACKED
+
+    const bool initially_unobserved = old_value == INFINITY;
+    const bool initially_free = !initially_unobserved && old_value < line_data->occupied_threshold;
+    const bool initially_occupied = !initially_unobserved && old_value >= line_data->occupied_threshold;
+    *was_occupied_voxel = initially_occupied;
+
+    // Check exclusion flags and skip this voxel if excluded.
+    // We skip by a 'break' statement which will break out of the compare and swap loop.
+    // Check skipping unobserved.
+    // We also check for zero adjustment here.
+    if (initially_unobserved && (line_data->region_update_flags & kRfExcludeUnobserved) || adjustment == 0)
+    {
+      adjustment = 0;  // Flag null adjustment. Prevents mean update.
+      break;
+    }
+
+    // Check skipping free.
+    if (initially_free && (line_data->region_update_flags & kRfExcludeFree))
+    {
+      adjustment = 0;  // Flag null adjustment. Prevents mean update.
+      break;
+    }
+
+    // Check skipping occupied.
+    if (initially_occupied && (line_data->region_update_flags & kRfExcludeOccupied))
+    {
+      adjustment = 0;  // Flag null adjustment. Prevents mean update.
+      break;
+    }
+
+    // Uninitialised voxels start at INFINITY.
+    new_value = (new_value != INFINITY) ? new_value + adjustment : adjustment;
+    // Clamp the value.
+    new_value = clamp(new_value, line_data->voxel_value_min, line_data->voxel_value_max);
+#ifdef OCCUPANCY_PACKED
+    new_word = (old_word & ~(0xffffu << shift)) | (((uint)packOccupancy(new_value) & 0xffffu) << shift);
+#endif  // OCCUPANCY_PACKED
+
+    // Now try write the value, looping if we fail to write the new value.
+#ifdef OCCUPANCY_PACKED
+  } while (new_word != old_word && !gputilAtomicCasU32(word_ptr, old_word, new_word));
+#else   // OCCUPANCY_PACKED
+  } while (new_value != old_value && !gputilAtomicCasF32(occupancy_ptr, old_value, new_value));
+#endif  // OCCUPANCY_PACKED
+
+  return adjustment;
+}
+
+
+/// Add @p distance to the traversal voxel at @p traversal_ptr. OpenCL has no floating point atomic arithmetic, so we
+/// use a compare and swap loop. CUDA uses the native atomic add, which avoids retries under contention.
+inline __device__ void regionAddTraversal(__global atomic_float *traversal_ptr, float distance)
+{
+#if GPUTIL_DEVICE == GPUTIL_CUDA
+  gputilAtomicAddF32(traversal_ptr, distance);
+#else   // GPUTIL_DEVICE == GPUTIL_CUDA
+  float old_value, new_value;
+#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
+  const int iteration_limit = 20;
+  int iterations = 0;
+#endif
+  do
+  {
+#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
+    if (iterations++ > iteration_limit)
+    {
+      break;
+    }
+#endif
+    old_value = gputilAtomicLoadF32(traversal_ptr);
+    new_value = old_value + distance;
+  } while (new_value != old_value && !gputilAtomicCasF32(traversal_ptr, old_value, new_value));
+#endif  // GPUTIL_DEVICE == GPUTIL_CUDA
+}
+
+
+/// Add @p delta to a work group local aggregation value. Native shared memory atomic add for CUDA, compare and swap
+/// loop otherwise.
+inline __device__ void regionAggregateAddF32(__local atomic_float *value, float delta)
+{
+#if GPUTIL_DEVICE == GPUTIL_CUDA
+  gputilAtomicAddF32L(value, delta);
+#else   // GPUTIL_DEVICE == GPUTIL_CUDA
+  float old_value, new_value;
+  do
+  {
+    old_value = gputilAtomicLoadF32L(value);
+    new_value = old_value + delta;
+  } while (!gputilAtomicCasF32L(value, old_value, new_value));
+#endif  // GPUTIL_DEVICE == GPUTIL_CUDA
+}
+
+
+/// Accumulate a ray voxel update into the work group aggregation table in local memory.
+///
+/// The table is an open addressing hash table keyed on the voxel, so rays in the work group which pass through the
+/// same voxel share a slot and contend only in local memory. Each slot is written to global memory once by
+/// @c regionAggregateFlush() .
+///
+/// @param line_data Line walk data, with the @c current_region_index resolved for the voxel.
+/// @param vi_local Index of the voxel within the current region.
+/// @param adjustment Occupancy value adjustment for the voxel.
+/// @param distance Distance the ray travels through the voxel. Ignored if traversal is not being updated.
+/// @return True if the update has been aggregated, false if there is no slot available and the voxel must be updated
+///   directly.
+inline __device__ bool regionAggregateAdd(LineWalkData *line_data, ulonglong vi_local, float adjustment,
+                                          float distance)
+{
+  const uint region_volume =
+    line_data->region_dimensions.x * line_data->region_dimensions.y * line_data->region_dimensions.z;
+  const ulonglong wide_key = (ulonglong)line_data->current_region_index * region_volume + vi_local;
+  if (wide_key >= REGION_AGGREGATE_EMPTY)
+  {
+    // Key cannot be represented.
+    return false;
+  }
+
+  const uint key = (uint)wide_key;
+  // Fibonacci hash, taking the high bits to spread neighbouring voxels across the table.
+  uint slot = (key * 2654435761u) >> (32 - REGION_AGGREGATE_SLOT_BITS);
+  for (int probe = 0; probe < REGION_AGGREGATE_PROBES; ++probe)
+  {
+    // Claim an empty slot or match a slot already claimed for this voxel. Claimed keys do not change until the table
+    // is flushed.
+    if (gputilAtomicCasU32L(&line_data->aggregate_keys[slot], REGION_AGGREGATE_EMPTY, key) ||
+        gputilAtomicLoadU32L(&line_data->aggregate_keys[slot]) == key)
+    {
+      regionAggregateAddF32(&line_data->aggregate_values[slot * 2 + 0], adjustment);
+      if (line_data->traversal_offsets)
+      {
+        regionAggregateAddF32(&line_data->aggregate_values[slot * 2 + 1], distance);
+      }
+      return true;
+    }
+    slot = (slot + 1) & (REGION_AGGREGATE_SLOTS - 1);
+  }
+
+  return false;
+}
+
+
+/// Write the aggregated voxel update in the given aggregation table @p slot to global memory. Empty slots are ignored.
+///
+/// The exclusion @c RayFlag values are tested once against the voxel value before the summed adjustment is applied and
+/// the result is clamped once.
+inline __device__ void regionAggregateFlush(LineWalkData *line_data, uint slot)
+{
+  const uint key = gputilAtomicLoadU32L(&line_data->aggregate_keys[slot]);
+  if (key == REGION_AGGREGATE_EMPTY)
+  {
+    return;
+  }
+
+  const uint region_volume =
+    line_data->region_dimensions.x * line_data->region_dimensions.y * line_data->region_dimensions.z;
+  const uint region_index = key / region_volume;
+  const ulonglong vi_local = key % region_volume;
+
+  if (line_data->dirty_spans)
+  {
+    regionMarkDirtySpan(line_data, region_index, vi_local);
+  }
+
+  bool was_occupied_voxel = false;
+  const ulonglong vi = (line_data->occupancy_offsets[region_index] / OCCUPANCY_VOXEL_SIZE) + vi_local;
+  regionAdjustOccupancy(line_data->occupancy, vi, gputilAtomicLoadF32L(&line_data->aggregate_values[slot * 2 + 0]),
+                        line_data, &was_occupied_voxel);
+
+  if (line_data->traversal_offsets)
+  {
+    const ulonglong traversal_vi =
+      (line_data->traversal_offsets[region_index] / sizeof(*line_data->traversal)) + vi_local;
+    regionAddTraversal(&line_data->traversal[traversal_vi],
+                       gputilAtomicLoadF32L(&line_data->aggregate_values[slot * 2 + 1]));
+  }
+}
+#endif  // REGION_UPDATE_BASE_CL
+
 __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_key, const GpuKey *end_key,
                                    int voxel_marker, float enter_range, float exit_range, void *user_data);
+#ifdef TSDF_FUSED
+__device__ bool REGION_FUSED_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_key, const GpuKey *end_key,
+                                         int voxel_marker, float enter_range, float exit_range, void *user_data);
+#endif  // TSDF_FUSED
 
 // Must be included after WALK_NAME and WALK_VISIT_VOXEL function is define
 #include "LineWalk.cl"
@@ -158,10 +509,7 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
 __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_key, const GpuKey *end_key,
                                    int voxel_marker, float enter_range, float exit_range, void *user_data)
 {
-  float old_value, new_value;
-
   LineWalkData *line_data = (LineWalkData *)user_data;
-  __global atomic_float *occupancy = line_data->occupancy;
 
   // Abort if this is the sample voxel and we are to exclude the sample. The sample voxel is detected when voxel_marker
   // is kLineWalkMarkerEnd is true and voxel[3] is zero. A value of 1 indicates a clipped ray and the end voxel does not
@@ -180,6 +528,18 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
     return true;
   }
 
+  if (is_sample_candidate && line_data->defer_sample)
+  {
+    // Defer the sample voxel until the aggregated ray voxel updates have been written. The sample candidate is always
+    // the last voxel visited.
+    copyKey(&line_data->deferred_key, voxel_key);
+    line_data->deferred_marker = voxel_marker;
+    line_data->deferred_enter_range = enter_range;
+    line_data->deferred_exit_range = exit_range;
+    line_data->has_deferred = true;
+    return true;
+  }
+
   // Resolve memory offset for the region of interest.
   if (!regionsResolveRegion(voxel_key, &line_data->current_region, &line_data->current_region_index,
                             line_data->region_keys, line_data->region_count))
@@ -201,73 +561,31 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
 
   // This voxel lies in the region. We will make a value adjustment.
   // Work out which voxel to modify.
-  const ulonglong vi_local = voxel_key->voxel[0] + voxel_key->voxel[1] * line_data->region_dimensions.x +
-                             voxel_key->voxel[2] * line_data->region_dimensions.x * line_data->region_dimensions.y;
-  ulonglong vi =
-    (line_data->occupancy_offsets[line_data->current_region_index] / sizeof(*line_data->occupancy)) + vi_local;
+  const ulonglong vi_local =
+    orderedVoxelIndex(voxel_key->voxel[0], voxel_key->voxel[1], voxel_key->voxel[2], line_data->region_dimensions.x,
+                      line_data->region_dimensions.y, line_data->region_dimensions.z, line_data->voxel_order);
+  ulonglong vi = (line_data->occupancy_offsets[line_data->current_region_index] / OCCUPANCY_VOXEL_SIZE) + vi_local;
 
   if (voxel_key->voxel[0] < line_data->region_dimensions.x && voxel_key->voxel[1] < line_data->region_dimensions.y &&
       voxel_key->voxel[2] < line_data->region_dimensions.z)
   {
-    __global atomic_float *occupancy_ptr = &occupancy[vi];
+    // Only ray voxels are aggregated. An adjustment > 0 updates per ray data such as the voxel mean.
+    if (line_data->aggregate_keys && adjustment <= 0 &&
+        regionAggregateAdd(line_data, vi_local, adjustment, exit_range - enter_range))
+    {
+      // The voxel and dirty span are updated when the aggregation table is flushed.
+      return true;
+    }
 
     bool was_occupied_voxel = false;
 
-#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
-    // Under high contension we can end up repeatedly failing to write the voxel value.
-    // The primary concern is not deadlocking the GPU, so we put a hard limit on the numebr of
-    // attempts made.
-    const int iteration_limit = 20;
-    int iterations = 0;
-#endif
-    do
+    if (line_data->dirty_spans)
     {
-#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
-      if (iterations++ > iteration_limit)
-      {
-        break;
-      }
-#endif
-      // Calculate a new value for the voxel.
-      old_value = new_value = gputilAtomicLoadF32(occupancy_ptr);
-
-      const bool initially_unobserved = old_value == INFINITY;
-      const bool initially_free = !initially_unobserved && old_value < line_data->occupied_threshold;
-      const bool initially_occupied = !initially_unobserved && old_value >= line_data->occupied_threshold;
-      was_occupied_voxel = initially_occupied;
-
-      // Check exclusion flags and skip this voxel if excluded.
-      // We skip by a 'break' statement which will break out of the compare and swap loop. Could return true.
-      // Check skipping unobserved.
-      // We also check for zero adjustment here.
-      if (initially_unobserved && (line_data->region_update_flags & kRfExcludeUnobserved) || adjustment == 0)
-      {
-        adjustment = 0;  // Flag null adjustment. Prevents mean update.
-        break;
-      }
-
-      // Check skipping free.
-      if (initially_free && (line_data->region_update_flags & kRfExcludeFree))
-      {
-        adjustment = 0;  // Flag null adjustment. Prevents mean update.
-        break;
-      }
-
-      // Check skipping occupied.
-      if (initially_occupied && (line_data->region_update_flags & kRfExcludeOccupied))
-      {
-        adjustment = 0;  // Flag null adjustment. Prevents mean update.
-        break;
-      }
-
-      // Uninitialised voxels start at INFINITY.
-      new_value = (new_value != INFINITY) ? new_value + adjustment : adjustment;
-      // Clamp the value.
-      new_value = clamp(new_value, line_data->voxel_value_min, line_data->voxel_value_max);
+      // Mark the span containing this voxel as modified. We mark before any exclusion checks, which is conservative.
+      regionMarkDirtySpan(line_data, line_data->current_region_index, vi_local);
+    }
 
-      // Now try write the value, looping if we fail to write the new value.
-      // mem_fence(CLK_GLOBAL_MEM_FENCE);
-    } while (new_value != old_value && !gputilAtomicCasF32(occupancy_ptr, old_value, new_value));
+    adjustment = regionAdjustOccupancy(line_data->occupancy, vi, adjustment, line_data, &was_occupied_voxel);
 
     if (adjustment > 0)
     {
@@ -295,26 +613,12 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
       }
     }
 
-    // Update traversal. There is no floating based atomic arithmetic, so we must do the same CAS style update.
+    // Update traversal.
     if (line_data->traversal_offsets)
     {
-#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
-      iterations = 0;
-#endif
       // Work out which voxel to modify.
       vi = (line_data->traversal_offsets[line_data->current_region_index] / sizeof(*line_data->traversal)) + vi_local;
-      __global atomic_float *traversal = &line_data->traversal[vi];
-      old_value = new_value = gputilAtomicLoadF32(traversal);
-      do
-      {
-#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
-        if (iterations++ > iteration_limit)
-        {
-          break;
-        }
-#endif
-        new_value += exit_range - enter_range;
-      } while (new_value != old_value && !gputilAtomicCasF32(traversal, old_value, new_value));
+      regionAddTraversal(&line_data->traversal[vi], exit_range - enter_range);
     }
 
     if (was_occupied_voxel && (line_data->region_update_flags & kRfStopOnFirstOccupied))
@@ -334,6 +638,94 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
   return true;
 }
 
+#ifdef TSDF_FUSED
+// Fused voxel visit: update the TSDF voxel then make the occupancy visit. The TSDF update matches visitVoxelTsdf() in
+// TsdfUpdate.cl and is made for every voxel in the ray, even after the occupancy visit stops the traversal, such as
+// for kRfStopOnFirstOccupied.
+__device__ bool REGION_FUSED_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_key, const GpuKey *end_key,
+                                         int voxel_marker, float enter_range, float exit_range, void *user_data)
+{
+  LineWalkData *line_data = (LineWalkData *)user_data;
+
+  if (regionsResolveRegion(voxel_key, &line_data->current_region, &line_data->current_region_index,
+                           line_data->region_keys, line_data->region_count) &&
+      voxel_key->voxel[0] < line_data->region_dimensions.x && voxel_key->voxel[1] < line_data->region_dimensions.y &&
+      voxel_key->voxel[2] < line_data->region_dimensions.z)
+  {
+    const ulonglong vi_local =
+      orderedVoxelIndex(voxel_key->voxel[0], voxel_key->voxel[1], voxel_key->voxel[2], line_data->region_dimensions.x,
+                        line_data->region_dimensions.y, line_data->region_dimensions.z, line_data->voxel_order);
+    const ulonglong vi =
+      (line_data->tsdf_offsets[line_data->current_region_index] / sizeof(*line_data->tsdf_voxels)) + vi_local;
+
+    // The TSDF sensor and sample are relative to the ray end voxel. We use the ray end key rather than the walk keys
+    // as the deferred sample visit of a reverse walk does not report the walk start key.
+    const int3 voxel_diff = keyDiff(voxel_key, &line_data->tsdf_key, line_data->region_dimensions);
+    const float3 voxel_centre =
+      make_float3(voxel_diff.x * line_data->voxel_resolution, voxel_diff.y * line_data->voxel_resolution,
+                  voxel_diff.z * line_data->voxel_resolution);
+
+    updateVoxelTsdf(&line_data->tsdf_voxels[vi], line_data->tsdf_sensor, line_data->tsdf_sample, voxel_centre,
+                    line_data->tsdf_default_truncation_distance, line_data->tsdf_max_weight,
+                    line_data->tsdf_dropoff_epsilon, line_data->tsdf_sparsity_compensation_factor);
+  }
+
+  if (line_data->occupancy_active)
+  {
+    line_data->occupancy_active =
+      REGION_VISIT_VOXEL(voxel_key, start_key, end_key, voxel_marker, enter_range, exit_range, user_data);
+  }
+
+  // Continue traversal
+  return true;
+}
+#endif  // TSDF_FUSED
+
+/// Walk the ray at @p ray_index, updating each voxel along the ray.
+///
+/// @param line_data Line walk data initialised for the batch. The per ray members are set here.
+/// @param line_keys Ray start/end key pairs. See @c REGION_UPDATE_KERNEL .
+/// @param local_lines Ray start/end point pairs. See @c REGION_UPDATE_KERNEL .
+/// @param touch_times Optional per ray touch times.
+/// @param ray_index Index of the ray to walk.
+__device__ void REGION_WALK_RAY(LineWalkData *line_data, __global GpuKey *line_keys, __global float3 *local_lines,
+                                __global uint *touch_times, uint ray_index)
+{
+  regionsInitCurrent(&line_data->current_region, &line_data->current_region_index);
+
+  // Now walk the clipped ray.
+  GpuKey start_key, end_key;
+  copyKey(&start_key, &line_keys[ray_index * 2 + 0]);
+  copyKey(&end_key, &line_keys[ray_index * 2 + 1]);
+
+  const float3 line_start = local_lines[ray_index * 2 + 0];
+  const float3 line_end = local_lines[ray_index * 2 + 1];
+
+  line_data->sample = line_end;
+  line_data->sensor = line_start;
+  line_data->touch_time = (touch_times) ? touch_times[ray_index] : 0;
+
+  int walk_flags = 0;
+  if (line_data->region_update_flags & kRfReverseWalk)
+  {
+    walk_flags |= kLineWalkFlagReverse;
+#ifndef NDT
+    // For non-NDT (pure occupancy) updates, force reporting the sample last. This yields better occupancy behaviour
+    // and less erosion.
+    walk_flags |= kLineWalkFlagForReportEndLast;
+#endif  // !NDT
+    walk_flags |= !!(line_data->region_update_flags & kRfExcludeOrigin) * kExcludeEndVoxel;
+  }
+  else
+  {
+    walk_flags |= !!(line_data->region_update_flags & kRfExcludeOrigin) * kExcludeStartVoxel;
+  }
+
+  // Call the line walking function.
+  REGION_WALK_VOXELS(&start_key, &end_key, line_start, line_end, line_data->region_dimensions,
+                     line_data->voxel_resolution, walk_flags, line_data);
+}
+
 //------------------------------------------------------------------------------
 // Kernel
 //------------------------------------------------------------------------------
@@ -392,6 +784,7 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
 /// @param line_count number of lines in @p line_keys and @p local_lines. These come in pairs, so the number of elements
 ///     in those arrays is double this value.
 /// @param region_dimensions Specifies the size of any one region in voxels.
+/// @param voxel_order Specifies the order of voxels in region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 /// @param voxel_resolution Specifies the size of a voxel cube.
 /// @param ray_adjustment Specifies the value adjustment to apply to voxels along the line segment leading up to the
 ///     final sample voxel. This should be < 0 to re-enforce as free.
@@ -400,8 +793,10 @@ __device__ bool REGION_VISIT_VOXEL(const GpuKey *voxel_key, const GpuKey *start_
 /// @param voxel_value_min Minimum clamping value for voxel adjustments.
 /// @param voxel_value_max Maximum clamping value for voxel adjustments.
 /// @param region_update_flags Update control values as per @c RayFlag.
+/// @param dirty_spans Optional output dirty span bit masks, one per region. A bit is set for each of the
+///     @c DIRTY_SPAN_COUNT spans of a region containing a voxel visited by a ray. Not available for NDT.
 __kernel void REGION_UPDATE_KERNEL(
-  __global atomic_float *occupancy, __global ulonglong *occupancy_region_mem_offsets_global,  //
+  __global OCCUPANCY_MEM_TYPE *occupancy, __global ulonglong *occupancy_region_mem_offsets_global,  //
   __global VoxelMean *means, __global ulonglong *means_region_mem_offsets_global,             //
 #ifdef NDT
   __global CovarianceVoxel *cov_voxels, __global ulonglong *cov_region_mem_offsets_global,         //
@@ -412,12 +807,24 @@ __kernel void REGION_UPDATE_KERNEL(
   __global atomic_uint *incident_voxels, __global ulonglong *incidents_region_mem_offsets_global,         //
   __global int3 *occupancy_region_keys_global, uint region_count,                                         //
   __global GpuKey *line_keys, __global float3 *local_lines, uint line_count, __global uint *touch_times,  //
-  int3 region_dimensions, float voxel_resolution, float ray_adjustment, float sample_adjustment,
+#ifndef NDT
+  __global atomic_uint *dirty_spans,  //
+#endif  // NDT
+#ifdef TSDF_FUSED
+  __global VoxelTsdf *tsdf_voxels, __global ulonglong *tsdf_region_mem_offsets_global,  //
+  __global float3 *unclipped_lines,                                                      //
+#endif  // TSDF_FUSED
+  int3 region_dimensions, uint voxel_order, float voxel_resolution, float ray_adjustment, float sample_adjustment,
   float occupied_threshold, float voxel_value_min, float voxel_value_max, uint region_update_flags
 #ifdef NDT
   ,
   float adaptation_rate, float sensor_noise
 #endif  // NDT
+#ifdef TSDF_FUSED
+  ,
+  float tsdf_max_weight, float tsdf_default_truncation_distance, float tsdf_dropoff_epsilon,
+  float tsdf_sparsity_compensation_factor
+#endif  // TSDF_FUSED
 )
 {
   // Only process valid lines.
@@ -445,8 +852,14 @@ __kernel void REGION_UPDATE_KERNEL(
   line_data.touch_times_offsets = touch_times_region_mem_offsets_global;
   line_data.incidents = incident_voxels;
   line_data.incidents_offsets = incidents_region_mem_offsets_global;
+#ifndef NDT
+  line_data.dirty_spans = dirty_spans;
+#else   // NDT
+  line_data.dirty_spans = 0;
+#endif  // NDT
   line_data.region_keys = occupancy_region_keys_global;
   line_data.region_dimensions = region_dimensions;
+  line_data.voxel_order = voxel_order;
   line_data.voxel_resolution = voxel_resolution;
   line_data.ray_adjustment = ray_adjustment;
   line_data.sample_adjustment = sample_adjustment;
@@ -456,46 +869,138 @@ __kernel void REGION_UPDATE_KERNEL(
   line_data.region_count = region_count;
   line_data.region_update_flags = region_update_flags;
 
-  regionsInitCurrent(&line_data.current_region, &line_data.current_region_index);
+  line_data.aggregate_keys = 0;
+  line_data.aggregate_values = 0;
+  line_data.defer_sample = false;
+  line_data.has_deferred = false;
+
+#ifdef TSDF_FUSED
+  line_data.tsdf_voxels = tsdf_voxels;
+  line_data.tsdf_offsets = tsdf_region_mem_offsets_global;
+  line_data.tsdf_max_weight = tsdf_max_weight;
+  line_data.tsdf_default_truncation_distance = tsdf_default_truncation_distance;
+  line_data.tsdf_dropoff_epsilon = tsdf_dropoff_epsilon;
+  line_data.tsdf_sparsity_compensation_factor = tsdf_sparsity_compensation_factor;
+  line_data.tsdf_sensor = unclipped_lines[get_global_id(0) * 2 + 0];
+  line_data.tsdf_sample = unclipped_lines[get_global_id(0) * 2 + 1];
+  copyKey(&line_data.tsdf_key, &line_keys[get_global_id(0) * 2 + 1]);
+  line_data.occupancy_active = true;
+#endif  // TSDF_FUSED
+
+  REGION_WALK_RAY(&line_data, line_keys, local_lines, touch_times, get_global_id(0));
+}
 
-  // Now walk the clipped ray.
-  GpuKey start_key, end_key;
-  copyKey(&start_key, &line_keys[get_global_id(0) * 2 + 0]);
-  copyKey(&end_key, &line_keys[get_global_id(0) * 2 + 1]);
+#if !defined(NDT) && !defined(TSDF_FUSED)
+/// A variant of @c regionRayUpdateOccupancy() which aggregates updates to the same voxel across the work group.
+///
+/// Rays converge near the sensor origin, so a work group of rays tends to visit the same voxels many times. The
+/// standard kernel resolves each visit with a global memory compare and swap loop, which serialises under contention.
+/// This kernel instead accumulates the occupancy adjustment and traversal for ray voxels in a local memory hash table
+/// keyed on the voxel. Once all rays in the work group have been walked, each table entry is written to global memory
+/// with a single compare and swap loop. Voxels which cannot be allocated a table slot are updated directly.
+///
+/// Sample voxels are not aggregated. They are updated after the work group has written the aggregated ray voxels,
+/// which mirrors the @c kLineWalkFlagForReportEndLast ordering in the standard kernel. Exclusion flags for an
+/// aggregated voxel are evaluated once against the voxel value before its summed adjustment is applied. The
+/// @c kRfStopOnFirstOccupied flag is not supported as aggregation hides the occupancy at each visit; use the standard
+/// kernel for that flag.
+///
+/// Parameters are as for @c regionRayUpdateOccupancy() with the addition of the local memory for the aggregation
+/// table.
+///
+/// Local memory requirement:
+/// - @p aggregate_keys : @c REGION_AGGREGATE_SLOTS @c uint values.
+/// - @p aggregate_values : 2 * @c REGION_AGGREGATE_SLOTS @c float values.
+__kernel void REGION_UPDATE_AGGREGATE_KERNEL(
+  __global OCCUPANCY_MEM_TYPE *occupancy, __global ulonglong *occupancy_region_mem_offsets_global,        //
+  __global VoxelMean *means, __global ulonglong *means_region_mem_offsets_global,                         //
+  __global atomic_float *traversal_voxels, __global ulonglong *traversal_region_mem_offsets_global,       //
+  __global atomic_uint *touch_time_voxels, __global ulonglong *touch_times_region_mem_offsets_global,     //
+  __global atomic_uint *incident_voxels, __global ulonglong *incidents_region_mem_offsets_global,         //
+  __global int3 *occupancy_region_keys_global, uint region_count,                                         //
+  __global GpuKey *line_keys, __global float3 *local_lines, uint line_count, __global uint *touch_times,  //
+  __global atomic_uint *dirty_spans,                                                                      //
+  int3 region_dimensions, uint voxel_order, float voxel_resolution, float ray_adjustment, float sample_adjustment,
+  float occupied_threshold, float voxel_value_min, float voxel_value_max,
+  uint region_update_flags LOCAL_ARG(atomic_uint *, aggregate_keys) LOCAL_ARG(atomic_float *, aggregate_values))
+{
+  LOCAL_MEM_ENABLE();
+  LOCAL_VAR(atomic_uint *, aggregate_keys, sizeof(uint) * REGION_AGGREGATE_SLOTS);
+  LOCAL_VAR(atomic_float *, aggregate_values, sizeof(float) * 2 * REGION_AGGREGATE_SLOTS);
 
-  const float3 line_start = local_lines[get_global_id(0) * 2 + 0];
-  const float3 line_end = local_lines[get_global_id(0) * 2 + 1];
+  for (uint i = get_local_id(0); i < REGION_AGGREGATE_SLOTS; i += get_local_size(0))
+  {
+    gputilAtomicInitU32L(&aggregate_keys[i], REGION_AGGREGATE_EMPTY);
+    gputilAtomicInitF32L(&aggregate_values[i * 2 + 0], 0.0f);
+    gputilAtomicInitF32L(&aggregate_values[i * 2 + 1], 0.0f);
+  }
 
-  line_data.sample = line_end;
-  line_data.sensor = line_start;
-  line_data.touch_time = (touch_times) ? touch_times[get_global_id(0)] : 0;
+  LineWalkData line_data;
+  line_data.occupancy = occupancy;
+  line_data.occupancy_offsets = occupancy_region_mem_offsets_global;
+  line_data.means = means;
+  line_data.means_offsets = means_region_mem_offsets_global;
+  line_data.traversal = traversal_voxels;
+  line_data.traversal_offsets = traversal_region_mem_offsets_global;
+  line_data.touch_times = touch_time_voxels;
+  line_data.touch_times_offsets = touch_times_region_mem_offsets_global;
+  line_data.incidents = incident_voxels;
+  line_data.incidents_offsets = incidents_region_mem_offsets_global;
+  line_data.dirty_spans = dirty_spans;
+  line_data.region_keys = occupancy_region_keys_global;
+  line_data.region_dimensions = region_dimensions;
+  line_data.voxel_order = voxel_order;
+  line_data.voxel_resolution = voxel_resolution;
+  line_data.ray_adjustment = ray_adjustment;
+  line_data.sample_adjustment = sample_adjustment;
+  line_data.occupied_threshold = occupied_threshold;
+  line_data.voxel_value_min = voxel_value_min;
+  line_data.voxel_value_max = voxel_value_max;
+  line_data.region_count = region_count;
+  line_data.region_update_flags = region_update_flags;
+  line_data.aggregate_keys = aggregate_keys;
+  line_data.aggregate_values = aggregate_values;
+  line_data.defer_sample = true;
+  line_data.has_deferred = false;
 
-  // For reverse line walk, the start voxel centre is always (0, 0, 0).
-  float3 start_voxel_centre = make_float3(0.0f, 0.0f, 0.0f);
-  int walk_flags = 0;
-  if (region_update_flags & kRfReverseWalk)
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Every thread must reach the barriers, so we cannot early out for invalid lines.
+  if (get_global_id(0) < line_count)
   {
-    walk_flags |= kLineWalkFlagReverse;
-#ifndef NDT
-    // For non-NDT (pure occupancy) updates, force reporting the sample last. This yields better occupancy behaviour
-    // and less erosion.
-    walk_flags |= kLineWalkFlagForReportEndLast;
-#endif  // !NDT
-    walk_flags |= !!(region_update_flags & kRfExcludeOrigin) * kExcludeEndVoxel;
+    REGION_WALK_RAY(&line_data, line_keys, local_lines, touch_times, get_global_id(0));
   }
-  else
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // Write the aggregation table.
+  for (uint i = get_local_id(0); i < REGION_AGGREGATE_SLOTS; i += get_local_size(0))
   {
-    walk_flags |= !!(region_update_flags & kRfExcludeOrigin) * kExcludeStartVoxel;
+    regionAggregateFlush(&line_data, i);
   }
 
-  // Call the line walking function.
-  REGION_WALK_VOXELS(&start_key, &end_key, line_start, line_end, region_dimensions, voxel_resolution, walk_flags,
-                     &line_data);
+  // Ensure the work group's aggregated ray voxel updates precede its sample voxel updates.
+  barrier(CLK_GLOBAL_MEM_FENCE);
+
+  if (line_data.has_deferred)
+  {
+    GpuKey start_key, end_key;
+    copyKey(&start_key, &line_keys[get_global_id(0) * 2 + 0]);
+    copyKey(&end_key, &line_keys[get_global_id(0) * 2 + 1]);
+    line_data.aggregate_keys = 0;
+    line_data.defer_sample = false;
+    REGION_VISIT_VOXEL(&line_data.deferred_key, &start_key, &end_key, line_data.deferred_marker,
+                       line_data.deferred_enter_range, line_data.deferred_exit_range, &line_data);
+  }
 }
+#endif  // !defined(NDT) && !defined(TSDF_FUSED)
 
 #undef REGION_UPDATE_KERNEL
+#undef REGION_UPDATE_AGGREGATE_KERNEL
+#undef REGION_WALK_RAY
 #undef REGION_WALK_VOXELS
 #undef REGION_VISIT_VOXEL
+#undef REGION_FUSED_VISIT_VOXEL
 #undef VOXEL_TYPE
 
 #ifndef REGION_UPDATE_BASE_CL
@@ -11,3 +11,4 @@
 #include "RegionUpdate.cl"
 
 GPUTIL_CUDA_DEFINE_KERNEL(regionRayUpdateOccupancy);
+GPUTIL_CUDA_DEFINE_KERNEL(regionRayUpdateOccupancyAggregate);
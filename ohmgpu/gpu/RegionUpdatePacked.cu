@@ -0,0 +1,15 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+#include <gputil/cuda/cutil_importcl.h>
+#include <gputil/gpu_ext.h>
+
+// Build base with 16-bit packed occupancy
+#define OCCUPANCY_PACKED
+#include "RegionUpdate.cl"
+
+GPUTIL_CUDA_DEFINE_KERNEL(regionRayUpdateOccupancyPacked);
+GPUTIL_CUDA_DEFINE_KERNEL(regionRayUpdateOccupancyAggregatePacked);
@@ -0,0 +1,155 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+#include "GpuKey.h"
+
+// Maximum number of probes made into the region set before a region key is appended without deduplication.
+#ifndef REGION_WALK_MAX_PROBES
+#define REGION_WALK_MAX_PROBES 32
+#endif  // REGION_WALK_MAX_PROBES
+
+/// Append the region key (@p rx, @p ry, @p rz) to @p regions using @p region_count to allocate the output index.
+///
+/// When @p region_set is non-null and 64-bit atomics are available (@c GPUTIL_ATOMICS_64 ), the key is first inserted
+/// into the @p region_set open addressing hash set and is only appended if not already present. The @p region_set
+/// must be zero initialised. Keys may still be duplicated if the set is too full.
+///
+/// The @p region_count is incremented for every appended region and may exceed @p max_regions on overflow.
+///
+/// @param rx Region key X coordinate.
+/// @param ry Region key Y coordinate.
+/// @param rz Region key Z coordinate.
+/// @param region_set Optional hash set of packed region keys used to deduplicate regions. May be null.
+/// @param region_set_capacity Number of entries in @p region_set . Must be a power of 2.
+/// @param regions Output region keys. Only the region part of the @c GpuKey is set.
+/// @param max_regions Capacity of @p regions .
+/// @param region_count Output region count.
+__device__ void regionWalkAppendKey(int rx, int ry, int rz, __global ulonglong *region_set, uint region_set_capacity,
+                                    __global GpuKey *regions, uint max_regions, __global atomic_uint *region_count);
+
+/// Append the keys of the regions touched by the line from @p start to @p end using @c regionWalkAppendKey() . This
+/// is the device equivalent of @c gpumap::walkRegions() .
+///
+/// The coordinates are in region units relative to the minimum corner of the @p reference_region .
+///
+/// @param start Line start in region units.
+/// @param end Line end in region units.
+/// @param reference_region The region key the coordinates are relative to.
+/// @param region_set See @c regionWalkAppendKey() .
+/// @param region_set_capacity See @c regionWalkAppendKey() .
+/// @param regions See @c regionWalkAppendKey() .
+/// @param max_regions See @c regionWalkAppendKey() .
+/// @param region_count See @c regionWalkAppendKey() .
+__device__ void regionWalkAppend(float3 start, float3 end, int3 reference_region, __global ulonglong *region_set,
+                                 uint region_set_capacity, __global GpuKey *regions, uint max_regions,
+                                 __global atomic_uint *region_count);
+
+#ifndef REGION_WALK_CL
+#define REGION_WALK_CL
+
+inline __device__ void regionWalkAppendKey(int rx, int ry, int rz, __global ulonglong *region_set,
+                                           uint region_set_capacity, __global GpuKey *regions, uint max_regions,
+                                           __global atomic_uint *region_count)
+{
+#if GPUTIL_ATOMICS_64
+  if (region_set)
+  {
+    // Pack the region key, offset by one so zero marks an empty entry.
+    const ulonglong packed =
+      ((ulonglong)(ushort)rx | ((ulonglong)(ushort)ry << 16) | ((ulonglong)(ushort)rz << 32)) + (ulonglong)1;
+    uint slot = (uint)((packed * (ulonglong)0x9E3779B97F4A7C15) >> 40) & (region_set_capacity - 1);
+    bool inserted = false;
+    for (uint probe = 0; probe < REGION_WALK_MAX_PROBES && !inserted; ++probe)
+    {
+      __global atomic_ulong *entry = (__global atomic_ulong *)&region_set[slot];
+      const ulonglong existing = gputilAtomicLoadU64(entry);
+      if (existing == packed)
+      {
+        // Already added.
+        return;
+      }
+
+      if (existing == 0)
+      {
+        // Retry the same entry on failure as the compare and swap may fail spuriously or to another thread adding
+        // the same key.
+        inserted = gputilAtomicCasU64(entry, 0, packed);
+        continue;
+      }
+
+      slot = (slot + 1) & (region_set_capacity - 1);
+    }
+  }
+#endif  // GPUTIL_ATOMICS_64
+
+  const uint region_index = gputilAtomicAdd(region_count, 1u);
+  if (region_index < max_regions)
+  {
+    regions[region_index].region[0] = (short)rx;
+    regions[region_index].region[1] = (short)ry;
+    regions[region_index].region[2] = (short)rz;
+    regions[region_index].voxel[0] = regions[region_index].voxel[1] = regions[region_index].voxel[2] =
+      regions[region_index].voxel[3] = 0;
+  }
+}
+
+
+inline __device__ void regionWalkAppend(float3 start, float3 end, int3 reference_region,
+                                        __global ulonglong *region_set, uint region_set_capacity,
+                                        __global GpuKey *regions, uint max_regions,
+                                        __global atomic_uint *region_count)
+{
+  const float start_coord[3] = { start.x, start.y, start.z };
+  const float end_coord[3] = { end.x, end.y, end.z };
+  int region[3];
+  int end_region[3];
+  int step[3];
+  float time_max[3];
+  float time_delta[3];
+
+  for (int i = 0; i < 3; ++i)
+  {
+    region[i] = (int)floor(start_coord[i]);
+    end_region[i] = (int)floor(end_coord[i]);
+    step[i] = (end_region[i] > region[i]) ? 1 : ((end_region[i] < region[i]) ? -1 : 0);
+    time_max[i] = time_delta[i] = 0;
+    if (step[i])
+    {
+      const float direction_axis_inv = 1.0f / (end_coord[i] - start_coord[i]);
+      const float next_region_border = (float)(region[i] + ((step[i] > 0) ? 1 : 0));
+      time_max[i] = (next_region_border - start_coord[i]) * direction_axis_inv;
+      time_delta[i] = (float)step[i] * direction_axis_inv;
+    }
+  }
+
+  // Only step along axes which have yet to reach the end region. This guarantees termination at the end region
+  // regardless of floating point error in time_max.
+  while (true)
+  {
+    regionWalkAppendKey(reference_region.x + region[0], reference_region.y + region[1],
+                        reference_region.z + region[2], region_set, region_set_capacity, regions, max_regions,
+                        region_count);
+
+    int axis = -1;
+    for (int i = 0; i < 3; ++i)
+    {
+      if (region[i] != end_region[i] && (axis < 0 || time_max[i] < time_max[axis]))
+      {
+        axis = i;
+      }
+    }
+
+    if (axis < 0)
+    {
+      break;
+    }
+
+    region[axis] += step[axis];
+    time_max[axis] += time_delta[axis];
+  }
+}
+
+#endif  // REGION_WALK_CL
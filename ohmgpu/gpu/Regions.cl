@@ -5,6 +5,7 @@
 // Author: Kazys Stepanas
 
 #include "GpuKey.h"
+#include "RegionTable.h"
 
 /// Initialises the @c currentRegion and @c regionIndex parameters for @c regionsResolveRegion().
 __device__ void regionsInitCurrent(int3 *currentRegion, uint *regionIndex);
@@ -47,6 +48,21 @@ __device__ void regionsInitCurrent(int3 *currentRegion, uint *regionIndex);
 __device__ bool regionsResolveRegion(const GpuKey *voxelKey, int3 *currentRegion, uint *regionIndex,
                                      __global int3 *regionKeys, uint regionCount);
 
+/// A variant of @c regionsResolveRegion() which resolves regions using a device region table rather than a region key
+/// array. This supports resolving any region resident in the @c GpuLayerCache which maintains the @p regionTable ,
+/// rather than only the regions listed for a batch.
+///
+/// @param voxelKey The voxel for which we want to find the region data memory offset.
+/// @param[in,out] currentRegion On enter, the current/last region reference. On successful exit, the region containing
+///     @p voxelKey.
+/// @param[in,out] regionSlot On enter, the cache slot for @p currentRegion . On successful exit, the cache slot for the
+///     region containing @p voxelKey . See @c RegionTableEntry::slot .
+/// @param regionTable The region table.
+/// @param regionTableCapacity The capacity of @p regionTable .
+/// @return True if a region for @p voxelKey is found, false otherwise.
+__device__ bool regionsResolveRegionTable(const GpuKey *voxelKey, int3 *currentRegion, uint *regionSlot,
+                                          __global const RegionTableEntry *regionTable, uint regionTableCapacity);
+
 #ifndef REGIONS_CL
 #define REGIONS_CL
 inline __device__ void regionsInitCurrent(int3 *currentRegion, uint *regionIndex)
@@ -92,6 +108,31 @@ inline __device__ bool regionsResolveRegion(const GpuKey *voxelKey, int3 *curren
   return false;
 }
 
+inline __device__ bool regionsResolveRegionTable(const GpuKey *voxelKey, int3 *currentRegion, uint *regionSlot,
+                                                 __global const RegionTableEntry *regionTable,
+                                                 uint regionTableCapacity)
+{
+  if (voxelKey->region[0] == currentRegion->x && voxelKey->region[1] == currentRegion->y &&
+      voxelKey->region[2] == currentRegion->z)
+  {
+    // Same region. No update required.
+    return true;
+  }
+
+  uint slot = 0;
+  if (regionTableLookup(regionTable, regionTableCapacity, voxelKey->region[0], voxelKey->region[1],
+                        voxelKey->region[2], &slot))
+  {
+    currentRegion->x = voxelKey->region[0];
+    currentRegion->y = voxelKey->region[1];
+    currentRegion->z = voxelKey->region[2];
+    *regionSlot = slot;
+    return true;
+  }
+
+  return false;
+}
+
 // inline __device__ uint regionVoxelIndex(uint regionIndex, __global ulonglong *regionMemOffsets, uint voxelSizeBytes)
 // {
 //   return regionMemOffsets[regionIndex] / voxelSizeBytes;
@@ -7,6 +7,7 @@
 
 // Explicitly include MapCoord.h first.
 #include "MapCoord.h"
+#include "VoxelOrderCompute.h"
 
 #include "Regions.cl"
 
@@ -62,6 +63,10 @@
 // TODO: include flags header instead of repeating definitions here.
 #define kUnknownAsOccupied (1 << 0)
 
+// Channel voxel w flags: marks which channel offsets track an obstruction.
+#define kChannelHorizontal (1 << 0)
+#define kChannelOverhead (1 << 1)
+
 // Limit the number of cells we can traverse in the line traversal. This is a worst case limit.
 //#define LIMIT_LINE_WALK_ITERATIONS
 // Limit the number of times we try update a voxel value. Probably best to always have this enabled.
@@ -661,10 +666,12 @@ void __device__ loadPropagationLocalVoxels(__global char4 *srcVoxels, __local ch
 /// @param workingVoxels Identifies the offset to the nearest obstructed voxel in voxel units.
 ///   The w coordinate is zero if there is no obstructed in range and the voxel itself isn't and obstructed.
 ///   The w coordinate is 1 if there is an obstructed to consider.
+/// @param voxelOrder The order of voxels in @p voxelOccupancy region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 __kernel void seedRegionVoxels(__global GpuKey *cornerVoxelKey, __global float *voxelOccupancy,
                                __global char4 *workingVoxels, __global int3 *regionKeysGlobal,
                                __global ulonglong *regionMemOffsetsGlobal, uint regionCount, int3 regionVoxelDimensions,
-                               int3 workingVoxelExtents, float occupancyThresholdValue, uint flags, int zbatch)
+                               uint voxelOrder, int3 workingVoxelExtents, float occupancyThresholdValue, uint flags,
+                               int zbatch)
 {
   int3 effectiveGlobalId = make_int3(get_global_id(0), get_global_id(1), get_global_id(2) * zbatch);
   int3 voxelRegion;
@@ -688,8 +695,9 @@ __kernel void seedRegionVoxels(__global GpuKey *cornerVoxelKey, __global float *
       {
         // Found the region memory.
         // Index into voxels
-        const uint vidx_local = voxelKey.voxel[0] + voxelKey.voxel[1] * regionVoxelDimensions.x +
-                                voxelKey.voxel[2] * regionVoxelDimensions.x * regionVoxelDimensions.y;
+        const uint vidx_local =
+          orderedVoxelIndex(voxelKey.voxel[0], voxelKey.voxel[1], voxelKey.voxel[2], regionVoxelDimensions.x,
+                            regionVoxelDimensions.y, regionVoxelDimensions.z, voxelOrder);
         const uint vidx = (regionMemOffsetsGlobal[regionVoxelOffset] / sizeof(*voxelOccupancy)) + vidx_local;
         // Index into workingVoxels.
         const uint widx = effectiveGlobalId.x + effectiveGlobalId.y * workingVoxelExtents.x +
@@ -738,6 +746,7 @@ __kernel void seedRegionVoxels(__global GpuKey *cornerVoxelKey, __global float *
 /// @param regionMemOffsetsGlobal Array of index offsets into @c voxelOccupancy marking the start of each region.
 /// @param regionCount Number of elements in both @p regionKeysGlobal and @p regionMemOffsetsGlobal.
 /// @param regionVoxelDimensions The voxel dimensions of a single region in CPU.
+/// @param voxelOrder The order of voxels in @p voxelOccupancy region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 /// @param workingVoxelExtents The dimensions of @p workingVoxels.
 /// @param outerRegionPadding The amount of padding required around @c regionVoxelDimensions to correctly consider
 ///   external obstacles.
@@ -748,8 +757,9 @@ __kernel void seedRegionVoxels(__global GpuKey *cornerVoxelKey, __global float *
 __kernel void seedFromOuterRegions(__global GpuKey *cornerVoxelKey, __global float *voxelOccupancy,
                                    __global voxel_type *workingVoxels, __global int3 *regionKeysGlobal,
                                    __global ulonglong *regionMemOffsetsGlobal, uint regionCount,
-                                   int3 regionVoxelDimensions, int3 workingVoxelExtents, int3 outerRegionPadding,
-                                   float3 axisScaling, float occupancyThresholdValue, uint flags, int batch)
+                                   int3 regionVoxelDimensions, uint voxelOrder, int3 workingVoxelExtents,
+                                   int3 outerRegionPadding, float3 axisScaling, float occupancyThresholdValue,
+                                   uint flags, int batch)
 {
   local uint faceVolumeSizes[6];
   local int3 minFaceExtents[6];
@@ -804,8 +814,9 @@ __kernel void seedFromOuterRegions(__global GpuKey *cornerVoxelKey, __global flo
     {
       // Found the region memory.
       // Index into voxels
-      const uint vidx_local = voxelKey.voxel[0] + voxelKey.voxel[1] * regionVoxelDimensions.x +
-                              voxelKey.voxel[2] * regionVoxelDimensions.x * regionVoxelDimensions.y;
+      const uint vidx_local =
+        orderedVoxelIndex(voxelKey.voxel[0], voxelKey.voxel[1], voxelKey.voxel[2], regionVoxelDimensions.x,
+                          regionVoxelDimensions.y, regionVoxelDimensions.z, voxelOrder);
       const uint vidx = (regionMemOffsetsGlobal[regionVoxelOffset] / sizeof(*voxelOccupancy)) + vidx_local;
       const float occupancy = voxelOccupancy[vidx];
       const bool isObstruction = isOccupied(occupancy, occupancyThresholdValue, flags);
@@ -941,8 +952,13 @@ __kernel void propagateObstacles(__global char4 *srcVoxels, __global char4 *dstV
 
 /// Migrate from the working voxel data to the voxel clearance (distance) memory data.
 ///
+/// The @p workingVoxelExtents may cover a block of regions, in which case @p clearanceVoxels holds the clearance
+/// voxels for each region of the block in turn, ordered by region along X, then Y, then Z. The block dimensions in
+/// regions are @p workingVoxelExtents / @p regionVoxelDimensions . A single region block has
+/// @p workingVoxelExtents equal to @p regionVoxelDimensions .
+///
 /// @par Invocation
-/// One thread per region voxel.
+/// One thread per working voxel.
 ///
 /// @param cornerVoxelKey Key for the lower extents corner of the global work group. All other GPU threads can resolve
 /// their key by
@@ -957,24 +973,36 @@ __kernel void propagateObstacles(__global char4 *srcVoxels, __global char4 *dstV
 /// voxelClearanceGpu).
 /// @param regionCount Number of regions in @p regionKesyGlobal and @p regionMemOffsetsGlobal.
 /// @param regionVoxelDim Number of voxels along each axis in a single region.
+/// @param voxelOrder The order of voxels to write to @p clearanceVoxels . See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 /// @param workingVoxelExtents Extents within @p workingVoxels for which we actually want to generate results. This is
-///   the non-padded region.
+///   the non-padded block of regions and must be a multiple of @p regionVoxelDimensions .
 /// @param searchRange The maximum search range for the overall query. Obstacles beyond this range are ignored.
 /// @param voxelResolution Physical dimensions along each edge of each voxel.
 __kernel void migrateResults(__global float *clearanceVoxels, __global char4 *workingVoxels, int3 regionVoxelDimensions,
-                             int3 workingVoxelExtents, float searchRange, float voxelResolution, float3 axisScaling,
-                             uint flags)
+                             uint voxelOrder, int3 workingVoxelExtents, float searchRange, float voxelResolution,
+                             float3 axisScaling, uint flags)
 {
   // NOTE: Experimentation with invoking smaller global sizes was attempted, but to no performance benefit.
   // Tried:
   //  - Each worker thread processed a number of Z layers.
   //  - Each worker thread processed a whole X/Y layer.
 
-  const int3 regionIndex3 = make_int3(get_global_id(0), get_global_id(1), get_global_id(2));
-  if (0 <= regionIndex3.x && regionIndex3.x < regionVoxelDimensions.x && 0 <= regionIndex3.y &&
-      regionIndex3.y < regionVoxelDimensions.y && 0 <= regionIndex3.z && regionIndex3.z < regionVoxelDimensions.z)
+  const int3 workingIndex3 = make_int3(get_global_id(0), get_global_id(1), get_global_id(2));
+  if (0 <= workingIndex3.x && workingIndex3.x < workingVoxelExtents.x && 0 <= workingIndex3.y &&
+      workingIndex3.y < workingVoxelExtents.y && 0 <= workingIndex3.z && workingIndex3.z < workingVoxelExtents.z)
   {
-    const int3 workingIndex3 = make_int3(regionIndex3.x, regionIndex3.y, regionIndex3.z);
+    // Resolve the region within the block and the voxel within that region.
+    const int3 blockRegion3 =
+      make_int3(workingIndex3.x / regionVoxelDimensions.x, workingIndex3.y / regionVoxelDimensions.y,
+                workingIndex3.z / regionVoxelDimensions.z);
+    const int3 blockRegionDim =
+      make_int3(workingVoxelExtents.x / regionVoxelDimensions.x, workingVoxelExtents.y / regionVoxelDimensions.y,
+                workingVoxelExtents.z / regionVoxelDimensions.z);
+    const int3 regionIndex3 = make_int3(workingIndex3.x - blockRegion3.x * regionVoxelDimensions.x,
+                                        workingIndex3.y - blockRegion3.y * regionVoxelDimensions.y,
+                                        workingIndex3.z - blockRegion3.z * regionVoxelDimensions.z);
+    const uint blockRegionIndex =
+      blockRegion3.x + blockRegion3.y * blockRegionDim.x + blockRegion3.z * blockRegionDim.x * blockRegionDim.y;
 
     // if (isGlobalThread(0, 0, 0))
     // {
@@ -1003,14 +1031,226 @@ __kernel void migrateResults(__global float *clearanceVoxels, __global char4 *wo
     //     clearance);
     // }
 
-    // Index to write to. Assume writing only to regionVoxelDimensions
-    const uint vidx = regionIndex3.x + regionIndex3.y * regionVoxelDimensions.x +
-                      regionIndex3.z * regionVoxelDimensions.x * regionVoxelDimensions.y;
+    // Index to write to: the region's clearance voxels within the block.
+    const uint vidx = blockRegionIndex * volumeOf(regionVoxelDimensions) +
+                      orderedVoxelIndex(regionIndex3.x, regionIndex3.y, regionIndex3.z, regionVoxelDimensions.x,
+                                        regionVoxelDimensions.y, regionVoxelDimensions.z, voxelOrder);
 
     clearanceVoxels[vidx] = clearance;
   }
 }
 
+/// Seed the clearance channel voxels. The channel voxels cover the working voxels plus @p outerPadding on each side,
+/// with the first entry corresponding to @p cornerVoxelKey offset by -outerPadding. Channels are calculated over the
+/// padded extents, so unlike @c seedRegionVoxels() there is no separate seeding of outer obstacles.
+///
+/// Each channel voxel tracks the XY offset to its nearest horizontal obstruction in @c x, @c y and the Z offset to
+/// its nearest overhead obstruction in @c z . The @c w coordinate flags which channels track an obstruction:
+/// @c kChannelHorizontal and @c kChannelOverhead .
+///
+/// @par Invocation
+/// One thread per channel voxel.
+///
+/// @param cornerVoxelKey Key for the lower extents corner of the working voxels (not the padded extents).
+/// @param voxelOccupancy Voxel occupancy data from the CPU. Indexing is done in conjunction with @p regionKeysGlobal
+///    and @p regionMemOffsetGlobal.
+/// @param channelVoxels The channel voxels to seed.
+/// @param regionKeysGlobal Array of region keys corresponding to entries in @p regionMemOffsetsGlobal.
+/// @param regionMemOffsetsGlobal Array of index offsets into @c voxelOccupancy marking the start of each region.
+/// @param regionCount Number of elements in both @p regionKeysGlobal and @p regionMemOffsetsGlobal.
+/// @param regionVoxelDimensions The voxel dimensions of a single region in CPU.
+/// @param voxelOrder The order of voxels in @p voxelOccupancy region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
+/// @param channelExtents The dimensions of @p channelVoxels : the working extents plus twice @p outerPadding .
+/// @param outerPadding The padding around the working voxels.
+/// @param occupancyThresholdValue Occupancy threshold value.
+/// @param flags Flags modifying behaviour. See @c kUnknownAsOccupied .
+__kernel void seedChannels(__global GpuKey *cornerVoxelKey, __global float *voxelOccupancy,
+                           __global char4 *channelVoxels, __global int3 *regionKeysGlobal,
+                           __global ulonglong *regionMemOffsetsGlobal, uint regionCount, int3 regionVoxelDimensions,
+                           uint voxelOrder, int3 channelExtents, int3 outerPadding, float occupancyThresholdValue,
+                           uint flags)
+{
+  const int3 channelIndex3 = make_int3(get_global_id(0), get_global_id(1), get_global_id(2));
+  if (channelIndex3.x >= channelExtents.x || channelIndex3.y >= channelExtents.y || channelIndex3.z >= channelExtents.z)
+  {
+    return;
+  }
+
+  int3 voxelRegion;
+  uint regionVoxelOffset;
+  regionsInitCurrent(&voxelRegion, &regionVoxelOffset);
+
+  GpuKey voxelKey = *cornerVoxelKey;
+  moveKeyAlongAxis(&voxelKey, 0, channelIndex3.x - outerPadding.x, regionVoxelDimensions);
+  moveKeyAlongAxis(&voxelKey, 1, channelIndex3.y - outerPadding.y, regionVoxelDimensions);
+  moveKeyAlongAxis(&voxelKey, 2, channelIndex3.z - outerPadding.z, regionVoxelDimensions);
+
+  // Unresolved regions are unknown.
+  float occupancy = INFINITY;
+  if (regionsResolveRegion(&voxelKey, &voxelRegion, &regionVoxelOffset, regionKeysGlobal, regionCount))
+  {
+    const uint vidx_local =
+      orderedVoxelIndex(voxelKey.voxel[0], voxelKey.voxel[1], voxelKey.voxel[2], regionVoxelDimensions.x,
+                        regionVoxelDimensions.y, regionVoxelDimensions.z, voxelOrder);
+    occupancy = voxelOccupancy[(regionMemOffsetsGlobal[regionVoxelOffset] / sizeof(*voxelOccupancy)) + vidx_local];
+  }
+
+  const bool isObstruction = isOccupied(occupancy, occupancyThresholdValue, flags);
+  const uint cidx = channelIndex3.x + channelIndex3.y * channelExtents.x +
+                    channelIndex3.z * channelExtents.x * channelExtents.y;
+  channelVoxels[cidx] = make_char4(0, 0, 0, (isObstruction) ? (kChannelHorizontal | kChannelOverhead) : 0);
+}
+
+
+/// Propagate the clearance channels by one voxel. This is invoked alongside @c propagateObstacles() for each
+/// propagation iteration.
+///
+/// The horizontal channel considers the eight neighbours in the voxel's XY plane, selecting the closest obstruction
+/// using the X and Y @p axisScaling . The overhead channel considers only the voxel directly above. As obstructions
+/// propagate one voxel per iteration, the first overhead obstruction to arrive is the nearest and is retained.
+///
+/// @par Invocation
+/// One thread per channel voxel.
+///
+/// @param srcVoxels The channel voxels from the previous iteration.
+/// @param dstVoxels The channel voxels to write.
+/// @param channelExtents The dimensions of the channel voxels.
+/// @param axisScaling Scaling applied to each axis when calculating the nearest obstruction.
+__kernel void propagateChannels(__global char4 *srcVoxels, __global char4 *dstVoxels, int3 channelExtents,
+                                float3 axisScaling)
+{
+  const int3 channelIndex3 = make_int3(get_global_id(0), get_global_id(1), get_global_id(2));
+  if (channelIndex3.x >= channelExtents.x || channelIndex3.y >= channelExtents.y || channelIndex3.z >= channelExtents.z)
+  {
+    return;
+  }
+
+  const int planeSize = channelExtents.x * channelExtents.y;
+  const uint cidx = channelIndex3.x + channelIndex3.y * channelExtents.x + channelIndex3.z * planeSize;
+  char4 channels = srcVoxels[cidx];
+
+  // Horizontal channel: select the closest obstruction in the XY plane.
+  float closestDistSqr = INFINITY;
+  if (channels.w & kChannelHorizontal)
+  {
+    const float sx = channels.x * axisScaling.x;
+    const float sy = channels.y * axisScaling.y;
+    closestDistSqr = sx * sx + sy * sy;
+  }
+
+  for (int y = -1; y <= 1; ++y)
+  {
+    for (int x = -1; x <= 1; ++x)
+    {
+      const int nx = channelIndex3.x + x;
+      const int ny = channelIndex3.y + y;
+      if ((x || y) && 0 <= nx && nx < channelExtents.x && 0 <= ny && ny < channelExtents.y)
+      {
+        const char4 neighbour = srcVoxels[nx + ny * channelExtents.x + channelIndex3.z * planeSize];
+        if (neighbour.w & kChannelHorizontal)
+        {
+          // Offset from this voxel to the neighbour's obstruction.
+          const int ox = neighbour.x + x;
+          const int oy = neighbour.y + y;
+          const float sx = ox * axisScaling.x;
+          const float sy = oy * axisScaling.y;
+          const float distSqr = sx * sx + sy * sy;
+          if (distSqr < closestDistSqr)
+          {
+            closestDistSqr = distSqr;
+            channels.x = (char)ox;
+            channels.y = (char)oy;
+            channels.w |= kChannelHorizontal;
+          }
+        }
+      }
+    }
+  }
+
+  // Overhead channel: pull the obstruction down from the voxel above.
+  if (!(channels.w & kChannelOverhead) && channelIndex3.z + 1 < channelExtents.z)
+  {
+    const char4 above = srcVoxels[cidx + planeSize];
+    if (above.w & kChannelOverhead)
+    {
+      channels.z = (char)(above.z + 1);
+      channels.w |= kChannelOverhead;
+    }
+  }
+
+  dstVoxels[cidx] = channels;
+}
+
+
+/// Migrate the clearance channel voxels to the clearance channels memory. The output holds a pair of floats per
+/// voxel - horizontal then overhead clearance - with regions ordered as for @c migrateResults() .
+///
+/// @par Invocation
+/// One thread per working voxel.
+///
+/// @param channelsOut The output clearance channels: two floats per voxel.
+/// @param channelVoxels The channel voxels from @c propagateChannels() .
+/// @param regionVoxelDimensions Number of voxels along each axis in a single region.
+/// @param voxelOrder The order of voxels to write to @p channelsOut . See @c OHM_VOXEL_ORDER_ROW_MAJOR .
+/// @param workingVoxelExtents The non-padded block of regions to write results for.
+/// @param outerPadding The padding around the working voxels in @p channelVoxels .
+/// @param searchRange The maximum search range for the overall query. Obstacles beyond this range are ignored.
+/// @param voxelResolution Physical dimensions along each edge of each voxel.
+/// @param axisScaling Scaling applied to the reported ranges.
+__kernel void migrateChannels(__global float *channelsOut, __global char4 *channelVoxels, int3 regionVoxelDimensions,
+                              uint voxelOrder, int3 workingVoxelExtents, int3 outerPadding, float searchRange,
+                              float voxelResolution, float3 axisScaling)
+{
+  const int3 workingIndex3 = make_int3(get_global_id(0), get_global_id(1), get_global_id(2));
+  if (workingIndex3.x >= workingVoxelExtents.x || workingIndex3.y >= workingVoxelExtents.y ||
+      workingIndex3.z >= workingVoxelExtents.z)
+  {
+    return;
+  }
+
+  const int3 channelExtents =
+    make_int3(workingVoxelExtents.x + 2 * outerPadding.x, workingVoxelExtents.y + 2 * outerPadding.y,
+              workingVoxelExtents.z + 2 * outerPadding.z);
+  const uint cidx = (workingIndex3.x + outerPadding.x) + (workingIndex3.y + outerPadding.y) * channelExtents.x +
+                    (workingIndex3.z + outerPadding.z) * channelExtents.x * channelExtents.y;
+  const char4 channels = channelVoxels[cidx];
+
+  float horizontal = -1.0f;
+  if (channels.w & kChannelHorizontal)
+  {
+    const float sx = channels.x * voxelResolution * axisScaling.x;
+    const float sy = channels.y * voxelResolution * axisScaling.y;
+    horizontal = sqrt(sx * sx + sy * sy);
+    horizontal = (horizontal <= searchRange) ? horizontal : -1.0f;
+  }
+
+  float overhead = -1.0f;
+  if (channels.w & kChannelOverhead)
+  {
+    overhead = channels.z * voxelResolution * axisScaling.z;
+    overhead = (overhead <= searchRange) ? overhead : -1.0f;
+  }
+
+  // Resolve the region within the block and the voxel within that region.
+  const int3 blockRegion3 =
+    make_int3(workingIndex3.x / regionVoxelDimensions.x, workingIndex3.y / regionVoxelDimensions.y,
+              workingIndex3.z / regionVoxelDimensions.z);
+  const int3 blockRegionDim =
+    make_int3(workingVoxelExtents.x / regionVoxelDimensions.x, workingVoxelExtents.y / regionVoxelDimensions.y,
+              workingVoxelExtents.z / regionVoxelDimensions.z);
+  const uint blockRegionIndex =
+    blockRegion3.x + blockRegion3.y * blockRegionDim.x + blockRegion3.z * blockRegionDim.x * blockRegionDim.y;
+  const uint vidx = blockRegionIndex * volumeOf(regionVoxelDimensions) +
+                    orderedVoxelIndex(workingIndex3.x - blockRegion3.x * regionVoxelDimensions.x,
+                                      workingIndex3.y - blockRegion3.y * regionVoxelDimensions.y,
+                                      workingIndex3.z - blockRegion3.z * regionVoxelDimensions.z,
+                                      regionVoxelDimensions.x, regionVoxelDimensions.y, regionVoxelDimensions.z,
+                                      voxelOrder);
+
+  channelsOut[2 * vidx + 0] = horizontal;
+  channelsOut[2 * vidx + 1] = overhead;
+}
+
 #ifndef ROI_RANGE_FILL_BASE_CL
 #define ROI_RANGE_FILL_BASE_CL
 #endif  // ROI_RANGE_FILL_BASE_CL
@@ -14,3 +14,6 @@ GPUTIL_CUDA_DEFINE_KERNEL(seedRegionVoxels);
 GPUTIL_CUDA_DEFINE_KERNEL(seedFromOuterRegions);
 GPUTIL_CUDA_DEFINE_KERNEL(propagateObstacles);
 GPUTIL_CUDA_DEFINE_KERNEL(migrateResults);
+GPUTIL_CUDA_DEFINE_KERNEL(seedChannels);
+GPUTIL_CUDA_DEFINE_KERNEL(propagateChannels);
+GPUTIL_CUDA_DEFINE_KERNEL(migrateChannels);
@@ -0,0 +1,118 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+#include "gpu_ext.h"  // Must be first
+
+#include "GpuKey.h"
+#include "MapCoord.h"
+#include "VoxelOrderCompute.h"
+#include "VoxelSecondarySampleCompute.h"
+
+#include "Regions.cl"
+
+/// This kernel integrates secondary samples - such as lidar dual returns - into the @c VoxelSecondarySample layer and
+/// is executed one thread per sample. This is the GPU equivalent of @c RayMapperSecondarySample .
+///
+/// Each line runs from a primary sample to the secondary sample with the range being the line length. Only the
+/// secondary sample voxel is updated.
+///
+/// As for @c covarianceHitNdt , the @c VoxelSecondarySample cannot be updated atomically, so the kernel requires that
+/// the @c line_keys and corresponding @c local_lines are grouped (or sorted) such that all samples affecting a
+/// particular sample voxel appear in a contiguous range in the array. Only the first thread in each group continues
+/// execution, iterating the group to update the voxel and writing the result back without atomic operations.
+///
+/// @param secondary_sample_voxels The GPU cached @c VoxelSecondarySample data block.
+/// @param secondary_sample_region_mem_offsets_global Array of voxel region memory offsets into
+///     @p secondary_sample_voxels . Each element corresponds to a key in region_keys_global. The offsets are in
+///     bytes.
+/// @param region_keys_global Array of voxel region keys identifying regions available in GPU. There are
+///     @c region_count elements in this array.
+/// @param region_count Number of regions uploaded in GPU and addressable in @p region_keys_global .
+/// @param line_keys Array of primary/secondary sample pairs converted into @c GpuKey references. Must be ordered such
+///     that all secondary samples in the same voxel appear in a contiguous block.
+/// @param local_lines Array of primary/secondary sample pairs which generated the @c line_keys . Each pair is relative
+///     to the centre of the voxel containing the secondary sample.
+/// @param line_count number of lines in @p line_keys and @p local_lines. These come in pairs, so the number of elements
+///     in those arrays is double this value.
+/// @param region_dimensions Specifies the size of any one region in voxels.
+/// @param voxel_order Specifies the order of voxels in region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
+__kernel void secondarySampleUpdate(__global VoxelSecondarySample *secondary_sample_voxels,
+                                    __global ulonglong *secondary_sample_region_mem_offsets_global,
+                                    __global int3 *region_keys_global, uint region_count, __global GpuKey *line_keys,
+                                    __global float3 *local_lines, uint line_count, int3 region_dimensions,
+                                    uint voxel_order)
+{
+  if (get_global_id(0) >= line_count)
+  {
+    return;
+  }
+
+  // Get the sample voxel for this thread. The sample is the second key in each pair.
+  GpuKey start_voxel;
+  copyKey(&start_voxel, &line_keys[get_global_id(0) * 2 + 1]);
+  start_voxel.voxel[3] = 0;  // Clipped samples are skipped during iteration below.
+
+  // Only allow the first thread in each sample voxel group to do the update for that group.
+  GpuKey target_voxel;
+  copyKey(&target_voxel, &start_voxel);
+  if (get_global_id(0) > 0)
+  {
+    copyKey(&target_voxel, &line_keys[(get_global_id(0) - 1) * 2 + 1]);
+  }
+  target_voxel.voxel[3] = 0;
+
+  if (equalKeys(&target_voxel, &start_voxel) && get_global_id(0) > 0)
+  {
+    // Not the first thread for this voxel group. The first thread in the group will do the update.
+    return;
+  }
+
+  int3 dummy_region_key;
+  uint region_index;
+
+  regionsInitCurrent(&dummy_region_key, &region_index);
+  if (!regionsResolveRegion(&start_voxel, &dummy_region_key, &region_index, region_keys_global, region_count))
+  {
+    // Data not available in GPU memory.
+    return;
+  }
+
+  const uint region_local_index =
+    orderedVoxelIndex(start_voxel.voxel[0], start_voxel.voxel[1], start_voxel.voxel[2], region_dimensions.x,
+                      region_dimensions.y, region_dimensions.z, voxel_order);
+  const uint voxel_index = (uint)(region_local_index + secondary_sample_region_mem_offsets_global[region_index] /
+                                                         sizeof(*secondary_sample_voxels));
+
+  // Manual copy of the voxel: we had some issues with OpenCL assignment on structures.
+  VoxelSecondarySample voxel;
+  voxel.m2 = secondary_sample_voxels[voxel_index].m2;
+  voxel.range_mean = secondary_sample_voxels[voxel_index].range_mean;
+  voxel.count = secondary_sample_voxels[voxel_index].count;
+
+  // Iterate from the starting voxel until we change voxels or reach the end of the set.
+  for (uint i = get_global_id(0); i < line_count; ++i)
+  {
+    copyKey(&target_voxel, &line_keys[i * 2 + 1]);
+    if (!equalKeys(&target_voxel, &start_voxel))
+    {
+      // Change in voxel. Done collecting.
+      break;
+    }
+
+    // Skip clipped lines, marked by voxel[3] != 0. The end point is not a real sample.
+    if (target_voxel.voxel[3] == 0)
+    {
+      const float3 primary = local_lines[i * 2];
+      const float3 secondary = local_lines[i * 2 + 1];
+      addSecondarySampleF(&voxel, length(secondary - primary));
+    }
+  }
+
+  // Write results. We expect no contension at this point so we write results directly.
+  secondary_sample_voxels[voxel_index].m2 = voxel.m2;
+  secondary_sample_voxels[voxel_index].range_mean = voxel.range_mean;
+  secondary_sample_voxels[voxel_index].count = voxel.count;
+}
@@ -6,9 +6,18 @@
 
 #include "gpu_ext.h"  // Must be first
 
+#include "GpuKey.h"
+#include "RegionWalk.cl"
+
 __device__ float4 slerp(float4 from, float4 to, float interpolation_factor);
 __device__ float4 quaternion_rotate_quaterion(float4 a, float4 b);
 __device__ float3 quaternion_rotate_point(float4 rotation, float3 point);
+__device__ void interpolateSensorTransform(float sample_time, __global float *transform_timestamps,
+                                           __global float3 *transform_positions, __global float4 *transform_rotations,
+                                           uint transform_count, float3 *sensor_position, float4 *sensor_rotation);
+__device__ int3 transformRaysVoxelIndex(float3 voxel_coord);
+__device__ int transformRaysFloorDiv(int value, int divisor);
+__device__ void transformRaysKey(int3 voxel_index, int3 reference_region, int3 region_dim, GpuKey *key);
 
 
 __device__ float4 slerp(float4 from, float4 to, float interpolation_factor)
@@ -88,6 +97,93 @@ __device__ float3 quaternion_rotate_point(float4 rotation, float3 v)
 }
 
 
+/// Resolve the sensor transform at @p sample_time by interpolating the bracketing transforms. Positions are linearly
+/// interpolated while rotations are spherically interpolated. Times outside the transform range are clamped.
+__device__ void interpolateSensorTransform(float sample_time, __global float *transform_timestamps,
+                                           __global float3 *transform_positions, __global float4 *transform_rotations,
+                                           uint transform_count, float3 *sensor_position, float4 *sensor_rotation)
+{
+  // Find the appropriate transforms. Binary search the transforms.
+  uint from_index = 0;
+  uint to_index = transform_count - 1;
+
+  if (transform_count > 2)
+  {
+    // Binary search.
+    const uint iter_limit = 100000;
+    uint iter_count = 0;
+
+    if (transform_timestamps[0] <= sample_time && sample_time <= transform_timestamps[transform_count - 1])
+    {
+      while (from_index <= to_index && iter_count < iter_limit)
+      {
+        ++iter_count;
+        const uint mid_low = (from_index + to_index) / 2;
+        const uint mid_high = min(mid_low + 1, transform_count - 1);
+        // Adapted binary search for the index braketing sample_time.
+        if (sample_time >= transform_timestamps[mid_low] && sample_time <= transform_timestamps[mid_high])
+        {
+          from_index = mid_low;
+          to_index = mid_high;
+          break;
+        }
+        else if (sample_time <= transform_timestamps[mid_low])
+        {
+          to_index = mid_low - 1;
+        }
+        else
+        {
+          from_index = mid_low + 1;
+        }
+      }
+
+#ifdef DEBUG
+      if (iter_count >= iter_limit)
+      {
+        printf("transformTimestampedPoints(): Binary search failure (%u): %u / %u. search-bound(%u, %u), max(%u)",
+               get_global_id(0), iter_count, iter_limit, from_index, to_index, transform_count);
+        printf("Search Time: %f\n", sample_time);
+        printf("Times[%u]:\n", transform_count);
+        for (uint i = 0; i < transform_count; ++i)
+        {
+          printf("  %f\n", transform_timestamps[i]);
+        }
+      }
+#endif  // DEBUG
+    }
+    else
+    {
+#if DEBUG
+      printf("transformTimestampedPoints()[%u]: out of range %f: [%f, %f]\n", get_global_id(0), sample_time,
+             transform_timestamps[0], transform_timestamps[transform_count - 1]);
+#endif  // DEBUG
+      if (sample_time < transform_timestamps[0])
+      {
+        sample_time = transform_timestamps[0];
+        from_index = to_index = 0;
+      }
+      else
+      {
+        sample_time = transform_timestamps[transform_count - 1];
+        from_index = to_index = transform_count - 1;
+      }
+    }
+  }
+
+  // Have resolved the transform. Linearly interpoloate position and spherically rotation.
+  const float interpolation_factor =
+    (to_index != from_index) ? (sample_time - transform_timestamps[from_index]) /
+                                 (transform_timestamps[to_index] - transform_timestamps[from_index]) :
+                               0.0f;
+  *sensor_position =
+    transform_positions[from_index] +
+    interpolation_factor * (transform_positions[to_index] - transform_positions[from_index]);
+  *sensor_rotation = quaternion_rotate_quaterion(
+    transform_rotations[from_index],
+    slerp(transform_rotations[from_index], transform_rotations[to_index], interpolation_factor));
+}
+
+
 __kernel void transformTimestampedPoints(__global float3 *points, uint point_count,
                                          __global float *transform_timestamps, __global float3 *transform_positions,
                                          __global float4 *transform_rotations, uint transform_count, uint batch_size)
@@ -128,82 +224,10 @@ __kernel void transformTimestampedPoints(__global float3 *points, uint point_cou
     //   printf("%u / %u : %f %f %f\n", sample_index, point_count, sample_point.x, sample_point.y, sample_point.z);
     // }
 
-    // Find the appropriate transforms. Binary search the transforms.
-    uint from_index = 0;
-    uint to_index = transform_count - 1;
-
-    if (transform_count > 2)
-    {
-      // Binary search.
-      const uint iter_limit = 100000;
-      uint iter_count = 0;
-
-      if (transform_timestamps[0] <= sample_time && sample_time <= transform_timestamps[transform_count - 1])
-      {
-        while (from_index <= to_index && iter_count < iter_limit)
-        {
-          ++iter_count;
-          const uint mid_low = (from_index + to_index) / 2;
-          const uint mid_high = min(mid_low + 1, transform_count - 1);
-          // Adapted binary search for the index braketing sample_time.
-          if (sample_time >= transform_timestamps[mid_low] && sample_time <= transform_timestamps[mid_high])
-          {
-            from_index = mid_low;
-            to_index = mid_high;
-            break;
-          }
-          else if (sample_time <= transform_timestamps[mid_low])
-          {
-            to_index = mid_low - 1;
-          }
-          else
-          {
-            from_index = mid_low + 1;
-          }
-        }
-
-#ifdef DEBUG
-        if (iter_count >= iter_limit)
-        {
-          printf("transformTimestampedPoints(): Binary search failure (%u): %u / %u. search-bound(%u, %u), max(%u)",
-                 get_global_id(0), iter_count, iter_limit, from_index, to_index, transform_count);
-          printf("Search Time: %f\n", sample_time);
-          printf("Times[%u]:\n", transform_count);
-          for (uint i = 0; i < transform_count; ++i)
-          {
-            printf("  %f\n", transform_timestamps[i]);
-          }
-        }
-#endif  // DEBUG
-      }
-      else
-      {
-#if DEBUG
-        printf("transformTimestampedPoints()[%u]: out of range %f: [%f, %f]\n", get_global_id(0), sample_time,
-               transform_timestamps[0], transform_timestamps[transform_count - 1]);
-#endif  // DEBUG
-        if (sample_time < transform_timestamps[0])
-        {
-          sample_time = transform_timestamps[0];
-          from_index = to_index = 0;
-        }
-        else
-        {
-          sample_time = transform_timestamps[transform_count - 1];
-          from_index = to_index = transform_count - 1;
-        }
-      }
-    }
-
-    // Have resolved the transform. Linearly interpoloate position and spherically rotation.
-    const float interpolation_factor = (sample_time - transform_timestamps[from_index]) /
-                                       (transform_timestamps[to_index] - transform_timestamps[from_index]);
-    const float3 sensor_position =
-      transform_positions[from_index] +
-      interpolation_factor * (transform_positions[to_index] - transform_positions[from_index]);
-    const float4 sensor_rotation = quaternion_rotate_quaterion(
-      transform_rotations[from_index],
-      slerp(transform_rotations[from_index], transform_rotations[to_index], interpolation_factor));
+    float3 sensor_position;
+    float4 sensor_rotation;
+    interpolateSensorTransform(sample_time, transform_timestamps, transform_positions, transform_rotations,
+                               transform_count, &sensor_position, &sensor_rotation);
 
     // printf("GPU: %f(%f)  T(%f %f %f) R(%f %f %f %f)\n", sample_time, interpolation_factor, sensor_position.x,
     // sensor_position.y,
@@ -217,3 +241,136 @@ __kernel void transformTimestampedPoints(__global float3 *points, uint point_cou
     points[sample_index * 2 + 1] = sample_point;
   }
 }
+
+
+/// Floor a continuous voxel coordinate to a voxel index.
+inline __device__ int3 transformRaysVoxelIndex(float3 voxel_coord)
+{
+  return make_int3((int)floor(voxel_coord.x), (int)floor(voxel_coord.y), (int)floor(voxel_coord.z));
+}
+
+
+/// Integer division of @p value by @p divisor rounding towards negative infinity.
+inline __device__ int transformRaysFloorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((divisor - 1 - value) / divisor);
+}
+
+
+/// Convert a @p voxel_index relative to the minimum corner of the @p reference_region into a @c GpuKey .
+inline __device__ void transformRaysKey(int3 voxel_index, int3 reference_region, int3 region_dim, GpuKey *key)
+{
+  const int rx = transformRaysFloorDiv(voxel_index.x, region_dim.x);
+  const int ry = transformRaysFloorDiv(voxel_index.y, region_dim.y);
+  const int rz = transformRaysFloorDiv(voxel_index.z, region_dim.z);
+  key->region[0] = (short)(reference_region.x + rx);
+  key->region[1] = (short)(reference_region.y + ry);
+  key->region[2] = (short)(reference_region.z + rz);
+  key->voxel[0] = (uchar)(voxel_index.x - rx * region_dim.x);
+  key->voxel[1] = (uchar)(voxel_index.y - ry * region_dim.y);
+  key->voxel[2] = (uchar)(voxel_index.z - rz * region_dim.z);
+  key->voxel[3] = 0;
+}
+
+
+/// Transform sensor frame samples into map rays ready for the @c GpuMap region update kernels.
+///
+/// Each thread transforms one sample using the interpolated sensor pose at the sample time, applies the device
+/// equivalent of @c goodRayFilter() then appends the ray to the output buffers using @c counts[0] . The output matches
+/// the @c GpuMap batch buffers: @p line_keys holds start/end @c GpuKey pairs, while @p local_lines holds the ray
+/// relative to the end voxel centre. All regions touched by each ray are appended to @p regions using @c counts[1]
+/// which may exceed @p max_regions on overflow.
+///
+/// Positions are expressed relative to the centre of a reference voxel: @p reference_region , @p reference_voxel .
+///
+/// @param samples Sensor frame samples. The @c w component holds the sample time relative to the first transform.
+/// @param sample_count Number of @p samples .
+/// @param transform_timestamps Times for the sensor transforms.
+/// @param transform_positions Sensor positions relative to the reference voxel centre.
+/// @param transform_rotations Sensor rotations.
+/// @param transform_count Number of sensor transforms.
+/// @param reference_region Region key of the reference voxel.
+/// @param reference_voxel Local key of the reference voxel.
+/// @param region_dim Region voxel dimensions.
+/// @param voxel_resolution Voxel size.
+/// @param max_range Samples further than this from the sensor are rejected.
+/// @param touch_time_offset Time offset added to the sample time when encoding @p touch_times .
+/// @param touch_time_scale Scale applied when encoding @p touch_times : inverse of @c OHM_VOXEL_TOUCH_TIME_SCALE .
+/// @param line_keys Output ray start/end key pairs.
+/// @param local_lines Output rays relative to the end voxel centre.
+/// @param original_lines Optional copy of @p local_lines for maps requiring the original rays. May be null.
+/// @param touch_times Optional encoded sample times. May be null.
+/// @param counts Output ray and region counts respectively.
+/// @param regions Output keys of the touched regions. Only the region part is set.
+/// @param max_regions Capacity of @p regions .
+__kernel void transformRays(__global float4 *samples, uint sample_count, __global float *transform_timestamps,
+                            __global float3 *transform_positions, __global float4 *transform_rotations,
+                            uint transform_count, int3 reference_region, int3 reference_voxel, int3 region_dim,
+                            float voxel_resolution, float max_range, float touch_time_offset, float touch_time_scale,
+                            __global GpuKey *line_keys, __global float3 *local_lines, __global float3 *original_lines,
+                            __global uint *touch_times, __global atomic_uint *counts, __global GpuKey *regions,
+                            uint max_regions)
+{
+  const uint sample_index = (uint)get_global_id(0);
+  if (sample_index >= sample_count)
+  {
+    return;
+  }
+
+  const float4 sample_data = samples[sample_index];
+  float3 sample_point = make_float3(sample_data.x, sample_data.y, sample_data.z);
+
+  // Device equivalent of goodRayFilter(): reject bad samples and long rays.
+  if (!isfinite(sample_point.x) || !isfinite(sample_point.y) || !isfinite(sample_point.z) ||
+      dot(sample_point, sample_point) > max_range * max_range)
+  {
+    return;
+  }
+
+  float3 sensor_position;
+  float4 sensor_rotation;
+  interpolateSensorTransform(sample_data.w, transform_timestamps, transform_positions, transform_rotations,
+                             transform_count, &sensor_position, &sensor_rotation);
+  sample_point = sensor_position + quaternion_rotate_point(sensor_rotation, sample_point);
+
+  // Convert to voxel units relative to the minimum corner of the reference region.
+  const float3 reference_offset =
+    make_float3(reference_voxel.x + 0.5f, reference_voxel.y + 0.5f, reference_voxel.z + 0.5f);
+  const float3 start_coord = sensor_position / voxel_resolution + reference_offset;
+  const float3 end_coord = sample_point / voxel_resolution + reference_offset;
+  const int3 start_index = transformRaysVoxelIndex(start_coord);
+  const int3 end_index = transformRaysVoxelIndex(end_coord);
+
+  GpuKey start_key;
+  GpuKey end_key;
+  transformRaysKey(start_index, reference_region, region_dim, &start_key);
+  transformRaysKey(end_index, reference_region, region_dim, &end_key);
+
+  // Make the ray relative to the end voxel centre.
+  const float3 end_voxel_centre =
+    make_float3((float)(end_index.x - reference_voxel.x) * voxel_resolution,
+                (float)(end_index.y - reference_voxel.y) * voxel_resolution,
+                (float)(end_index.z - reference_voxel.z) * voxel_resolution);
+
+  const uint ray_index = gputilAtomicAdd(&counts[0], 1u);
+  copyKey(&line_keys[ray_index * 2 + 0], &start_key);
+  copyKey(&line_keys[ray_index * 2 + 1], &end_key);
+  local_lines[ray_index * 2 + 0] = sensor_position - end_voxel_centre;
+  local_lines[ray_index * 2 + 1] = sample_point - end_voxel_centre;
+  if (original_lines)
+  {
+    original_lines[ray_index * 2 + 0] = sensor_position - end_voxel_centre;
+    original_lines[ray_index * 2 + 1] = sample_point - end_voxel_centre;
+  }
+  if (touch_times)
+  {
+    touch_times[ray_index] = (uint)fmax(0.0f, (touch_time_offset + sample_data.w) * touch_time_scale);
+  }
+
+  const float3 start_region_coord = make_float3(start_coord.x / (float)region_dim.x,
+                                                start_coord.y / (float)region_dim.y,
+                                                start_coord.z / (float)region_dim.z);
+  const float3 end_region_coord = make_float3(end_coord.x / (float)region_dim.x, end_coord.y / (float)region_dim.y,
+                                              end_coord.z / (float)region_dim.z);
+  regionWalkAppend(start_region_coord, end_region_coord, reference_region, 0, 0u, regions, max_regions, &counts[1]);
+}
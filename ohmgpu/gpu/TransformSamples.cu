@@ -10,3 +10,4 @@
 #include "TransformSamples.cl"
 
 GPUTIL_CUDA_DEFINE_KERNEL(transformTimestampedPoints);
+GPUTIL_CUDA_DEFINE_KERNEL(transformRays);
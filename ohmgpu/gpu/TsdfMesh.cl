@@ -0,0 +1,283 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "gpu_ext.h"  // Must be first
+
+#include "VoxelOrderCompute.h"
+#include "VoxelTsdfCompute.h"
+
+/// @defgroup tsdfMeshGpu TSDF Mesh GPU
+/// @{
+/// @brief GPU code used to extract the zero crossing surface of a TSDF layer as a triangle mesh.
+///
+/// Each GPU thread processes one cube of a single region, where the cube corners are the centres of the voxel at the
+/// thread's voxel index and its neighbours at +1 along each axis. Cubes at the upper edges of the region sample voxels
+/// from the adjacent regions, so eight regions are resolved: the target region and its neighbours along the positive
+/// axes. These are identified by @c tsdf_region_mem_offsets indexed by the bit pattern (x | y << 1 | z << 2) of the
+/// region step. Missing regions are marked @c TM_NoRegion and any cube touching them is skipped.
+///
+/// Each cube is split into six tetrahedra around the main cube diagonal - marching tetrahedra - so the surface is
+/// generated without the marching cubes case tables. This split is the same for all cubes so the triangles of adjacent
+/// cubes match across the shared faces. Triangles are wound such that their normals face positive distance values,
+/// away from the surface.
+///
+/// Triangles are written to @c vertices as three vertex positions each, with three floats per vertex. Positions are
+/// relative to the minimum corner of the target region. Vertex positions are interpolated along each edge in a
+/// consistent order, so vertices shared by triangles are bitwise equal and may be welded by exact comparison. The
+/// @c vertex_count is incremented for all generated vertices, but no vertices are written beyond @c max_vertices ,
+/// allowing the caller to detect overflow and resize.
+
+#ifndef TSDF_MESH_CL
+#define TSDF_MESH_CL
+/// Memory offset value marking a missing region.
+#define TM_NoRegion (~(ulonglong)0u)
+
+/// Read the TSDF distance for the corner at region local @p coord , which may lie in a positive neighbour region.
+/// @return True if the voxel is available with at least @p min_weight .
+inline __device__ bool tmCornerValue(int3 coord, __global VoxelTsdf *tsdf_voxels,
+                                     __global ulonglong *tsdf_region_mem_offsets, int3 region_dimensions,
+                                     uint voxel_order, float min_weight, float *distance)
+{
+  uint region_index = 0;
+  if (coord.x >= region_dimensions.x)
+  {
+    coord.x -= region_dimensions.x;
+    region_index |= 1u;
+  }
+  if (coord.y >= region_dimensions.y)
+  {
+    coord.y -= region_dimensions.y;
+    region_index |= 2u;
+  }
+  if (coord.z >= region_dimensions.z)
+  {
+    coord.z -= region_dimensions.z;
+    region_index |= 4u;
+  }
+
+  const ulonglong mem_offset = tsdf_region_mem_offsets[region_index];
+  if (mem_offset == TM_NoRegion)
+  {
+    return false;
+  }
+
+  const ulonglong vi = orderedVoxelIndex(coord.x, coord.y, coord.z, region_dimensions.x, region_dimensions.y,
+                                         region_dimensions.z, voxel_order);
+  const VoxelTsdf voxel = tsdf_voxels[mem_offset / sizeof(VoxelTsdf) + vi];
+  *distance = voxel.distance;
+  return voxel.weight > 0 && voxel.weight >= min_weight;
+}
+
+
+/// Does corner coordinate @p a precede @p b ? Used to interpolate each edge in a consistent direction.
+inline __device__ bool tmCornerLess(int3 a, int3 b)
+{
+  return (a.z != b.z) ? a.z < b.z : ((a.y != b.y) ? a.y < b.y : a.x < b.x);
+}
+
+
+/// Calculate the zero crossing on the edge between corners @p a and @p b .
+inline __device__ float3 tmEdgeVertex(int3 coord_a, float distance_a, int3 coord_b, float distance_b,
+                                      float voxel_resolution)
+{
+  if (tmCornerLess(coord_b, coord_a))
+  {
+    const int3 coord_swap = coord_a;
+    const float distance_swap = distance_a;
+    coord_a = coord_b;
+    distance_a = distance_b;
+    coord_b = coord_swap;
+    distance_b = distance_swap;
+  }
+
+  const float t = distance_a / (distance_a - distance_b);
+  const float3 pos_a = make_float3((coord_a.x + 0.5f) * voxel_resolution, (coord_a.y + 0.5f) * voxel_resolution,
+                                   (coord_a.z + 0.5f) * voxel_resolution);
+  const float3 pos_b = make_float3((coord_b.x + 0.5f) * voxel_resolution, (coord_b.y + 0.5f) * voxel_resolution,
+                                   (coord_b.z + 0.5f) * voxel_resolution);
+  return pos_a + t * (pos_b - pos_a);
+}
+
+
+/// Write a triangle, winding it so the normal aligns with @p outward .
+inline __device__ void tmWriteTriangle(float3 v0, float3 v1, float3 v2, float3 outward, __global float *vertices,
+                                       uint vertex_index, uint max_vertices)
+{
+  if (vertex_index + 3 > max_vertices)
+  {
+    return;
+  }
+
+  if (dot(cross(v1 - v0, v2 - v0), outward) < 0)
+  {
+    const float3 swap = v1;
+    v1 = v2;
+    v2 = swap;
+  }
+
+  __global float *out = vertices + vertex_index * 3;
+  out[0] = v0.x;
+  out[1] = v0.y;
+  out[2] = v0.z;
+  out[3] = v1.x;
+  out[4] = v1.y;
+  out[5] = v1.z;
+  out[6] = v2.x;
+  out[7] = v2.y;
+  out[8] = v2.z;
+}
+
+
+/// Polygonise a single tetrahedron. Corners with negative distance are inside the surface.
+inline __device__ void tmTetrahedron(const int3 *coords, const float *distances, float voxel_resolution,
+                                     __global float *vertices, uint max_vertices, __global atomic_uint *vertex_count)
+{
+  uint inside_mask = 0;
+  uint inside_count = 0;
+  for (uint i = 0; i < 4; ++i)
+  {
+    if (distances[i] < 0)
+    {
+      inside_mask |= (1u << i);
+      ++inside_count;
+    }
+  }
+
+  if (inside_count == 0 || inside_count == 4)
+  {
+    return;
+  }
+
+  float3 pos[4];
+  for (uint i = 0; i < 4; ++i)
+  {
+    pos[i] = make_float3((float)coords[i].x, (float)coords[i].y, (float)coords[i].z);
+  }
+
+  if (inside_count == 1 || inside_count == 3)
+  {
+    // One corner is separated from the other three. Generate a triangle across the three edges around that corner.
+    const uint lone_mask = (inside_count == 1) ? inside_mask : (~inside_mask & 0xfu);
+    const uint a = (lone_mask & 1u) ? 0 : ((lone_mask & 2u) ? 1 : ((lone_mask & 4u) ? 2 : 3));
+    const uint b = (a + 1) % 4;
+    const uint c = (a + 2) % 4;
+    const uint d = (a + 3) % 4;
+
+    const float3 v0 = tmEdgeVertex(coords[a], distances[a], coords[b], distances[b], voxel_resolution);
+    const float3 v1 = tmEdgeVertex(coords[a], distances[a], coords[c], distances[c], voxel_resolution);
+    const float3 v2 = tmEdgeVertex(coords[a], distances[a], coords[d], distances[d], voxel_resolution);
+
+    // Outward points from the inside corners towards the outside corners.
+    const float3 lone_to_others = (pos[b] + pos[c] + pos[d]) * (1.0f / 3.0f) - pos[a];
+    const float3 outward = (inside_count == 1) ? lone_to_others : lone_to_others * -1.0f;
+
+    const uint vertex_index = gputilAtomicAdd(vertex_count, 3u);
+    tmWriteTriangle(v0, v1, v2, outward, vertices, vertex_index, max_vertices);
+    return;
+  }
+
+  // Two corners inside (a, b) and two outside (c, d). Generate a quad over the four edges joining them.
+  uint a = 4, b = 4, c = 4, d = 4;
+  for (uint i = 0; i < 4; ++i)
+  {
+    if (inside_mask & (1u << i))
+    {
+      if (a == 4)
+      {
+        a = i;
+      }
+      else
+      {
+        b = i;
+      }
+    }
+    else
+    {
+      if (c == 4)
+      {
+        c = i;
+      }
+      else
+      {
+        d = i;
+      }
+    }
+  }
+
+  const float3 v_ac = tmEdgeVertex(coords[a], distances[a], coords[c], distances[c], voxel_resolution);
+  const float3 v_ad = tmEdgeVertex(coords[a], distances[a], coords[d], distances[d], voxel_resolution);
+  const float3 v_bd = tmEdgeVertex(coords[b], distances[b], coords[d], distances[d], voxel_resolution);
+  const float3 v_bc = tmEdgeVertex(coords[b], distances[b], coords[c], distances[c], voxel_resolution);
+  const float3 outward = (pos[c] + pos[d]) - (pos[a] + pos[b]);
+
+  const uint vertex_index = gputilAtomicAdd(vertex_count, 6u);
+  tmWriteTriangle(v_ac, v_ad, v_bd, outward, vertices, vertex_index, max_vertices);
+  tmWriteTriangle(v_ac, v_bd, v_bc, outward, vertices, vertex_index + 3, max_vertices);
+}
+#endif  // TSDF_MESH_CL
+
+
+/// Extract the TSDF surface triangles for a single region.
+///
+/// @param tsdf_voxels The TSDF voxel cache memory.
+/// @param tsdf_region_mem_offsets Byte offsets into @p tsdf_voxels for the target region and its positive neighbours.
+///   Eight entries indexed by (x | y << 1 | z << 2) with @c TM_NoRegion for missing regions.
+/// @param region_dimensions Region voxel dimensions.
+/// @param voxel_order Order of voxels in region memory: @c OHM_VOXEL_ORDER_ROW_MAJOR etc.
+/// @param voxel_resolution Voxel size.
+/// @param min_weight Minimum TSDF weight for a voxel to be used as a cube corner.
+/// @param vertices Output triangle vertices; three floats per vertex, three vertices per triangle.
+/// @param max_vertices Capacity of @p vertices (vertex count).
+/// @param vertex_count Output vertex count. May exceed @p max_vertices on overflow.
+__kernel void tsdfMesh(__global VoxelTsdf *tsdf_voxels, __global ulonglong *tsdf_region_mem_offsets,
+                       int3 region_dimensions, uint voxel_order, float voxel_resolution, float min_weight,
+                       __global float *vertices, uint max_vertices, __global atomic_uint *vertex_count)
+{
+  const uint voxel_count = (uint)(region_dimensions.x * region_dimensions.y * region_dimensions.z);
+  const uint thread_index = (uint)get_global_id(0);
+  if (thread_index >= voxel_count)
+  {
+    return;
+  }
+
+  int3 base;
+  base.x = (int)(thread_index % (uint)region_dimensions.x);
+  base.y = (int)((thread_index / (uint)region_dimensions.x) % (uint)region_dimensions.y);
+  base.z = (int)(thread_index / (uint)(region_dimensions.x * region_dimensions.y));
+
+  // Cube corners: 0 (0,0,0), 1 (1,0,0), 2 (1,1,0), 3 (0,1,0), 4 (0,0,1), 5 (1,0,1), 6 (1,1,1), 7 (0,1,1).
+  int3 corner_coords[8];
+  float corner_distances[8];
+  for (int i = 0; i < 8; ++i)
+  {
+    corner_coords[i] = base;
+    corner_coords[i].x += ((i & 1) ^ ((i >> 1) & 1));
+    corner_coords[i].y += ((i >> 1) & 1);
+    corner_coords[i].z += ((i >> 2) & 1);
+
+    if (!tmCornerValue(corner_coords[i], tsdf_voxels, tsdf_region_mem_offsets, region_dimensions, voxel_order,
+                       min_weight, &corner_distances[i]))
+    {
+      return;
+    }
+  }
+
+  // Six tetrahedra sharing the 0-6 diagonal.
+  const int tetrahedra[6][4] = { { 0, 5, 1, 6 }, { 0, 1, 2, 6 }, { 0, 2, 3, 6 },
+                                 { 0, 3, 7, 6 }, { 0, 7, 4, 6 }, { 0, 4, 5, 6 } };
+  for (int t = 0; t < 6; ++t)
+  {
+    int3 coords[4];
+    float distances[4];
+    for (int i = 0; i < 4; ++i)
+    {
+      coords[i] = corner_coords[tetrahedra[t][i]];
+      distances[i] = corner_distances[tetrahedra[t][i]];
+    }
+    tmTetrahedron(coords, distances, voxel_resolution, vertices, max_vertices, vertex_count);
+  }
+}
+
+/// @}
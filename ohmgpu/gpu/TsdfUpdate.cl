@@ -40,10 +40,12 @@
 
 #include "MapCoord.h"
 #include "RayFlag.h"
+#include "VoxelOrderCompute.h"
 #include "VoxelTsdfCompute.h"
 
 #include "LineWalkMarkers.cl"
 #include "Regions.cl"
+#include "TsdfVoxel.cl"
 
 //------------------------------------------------------------------------------
 // Declarations
@@ -76,6 +78,8 @@ typedef struct TsdfWalkData_t
   int3 current_region;
   // Size of a region in voxels.
   int3 region_dimensions;
+  /// Order of voxels in region memory: OHM_VOXEL_ORDER_ROW_MAJOR, OHM_VOXEL_ORDER_MORTON or OHM_VOXEL_ORDER_BRICK4.
+  uint voxel_order;
   // Number of regions in region_keys/region_mem_offsets.
   uint region_count;
   // Index of the @c current_region into region_keys and corresponding xxx_offsets arrays.
@@ -117,22 +121,15 @@ __device__ bool visitVoxelTsdf(const GpuKey *voxel_key, const GpuKey *start_key,
 
   // We assume this voxel lies in the tsdf_data->current_region.
   // Work out which voxel to modify.
-  const ulonglong vi_local = voxel_key->voxel[0] + voxel_key->voxel[1] * tsdf_data->region_dimensions.x +
-                             voxel_key->voxel[2] * tsdf_data->region_dimensions.x * tsdf_data->region_dimensions.y;
+  const ulonglong vi_local =
+    orderedVoxelIndex(voxel_key->voxel[0], voxel_key->voxel[1], voxel_key->voxel[2], tsdf_data->region_dimensions.x,
+                      tsdf_data->region_dimensions.y, tsdf_data->region_dimensions.z, tsdf_data->voxel_order);
   ulonglong vi =
     (tsdf_data->tsdf_offsets[tsdf_data->current_region_index] / sizeof(*tsdf_data->tsdf_voxels)) + vi_local;
 
   if (voxel_key->voxel[0] < tsdf_data->region_dimensions.x && voxel_key->voxel[1] < tsdf_data->region_dimensions.y &&
       voxel_key->voxel[2] < tsdf_data->region_dimensions.z)
   {
-#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
-    // Under high contension we can end up repeatedly failing to write the voxel value.
-    // The primary concern is not deadlocking the GPU, so we put a hard limit on the numebr of
-    // attempts made.
-    const int iteration_limit = 20;
-    int iterations = 0;
-#endif
-
     // Calculate the current voxel centre in the same space as tsdf_data->sensor and tsdf_data->sample. Remember,
     // those values are both calculated relative to the centre of the voxel containing tsdf_data->sample
     const bool reverse_walk = tsdf_data->region_update_flags & kRfReverseWalk;
@@ -141,40 +138,9 @@ __device__ bool visitVoxelTsdf(const GpuKey *voxel_key, const GpuKey *start_key,
       make_float3(voxel_diff.x * tsdf_data->voxel_resolution, voxel_diff.y * tsdf_data->voxel_resolution,
                   voxel_diff.z * tsdf_data->voxel_resolution);
 
-    /// Use a union of VoxelTsdf and atomic_ulong (64-bits) so we can write the value back in one operation.
-    union
-    {
-      VoxelTsdf voxel;
-      ulonglong value;
-    } initial, updated_tsdf;
-
-    __global atomic_ulong *tsdf_voxel_ptr = (__global atomic_ulong *)&tsdf_data->tsdf_voxels[vi];
-
-    do
-    {
-#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
-      if (iterations++ > iteration_limit)
-      {
-        break;
-      }
-#endif  // LIMIT_VOXEL_WRITE_ITERATIONS
-
-      initial.value = gputilAtomicLoadU64(tsdf_voxel_ptr);
-      updated_tsdf.voxel.weight = initial.voxel.weight;
-      updated_tsdf.voxel.distance = initial.voxel.distance;
-
-      if (!calculateTsdf(tsdf_data->sensor, tsdf_data->sample, voxel_centre, tsdf_data->default_truncation_distance,
-                         tsdf_data->max_weight, tsdf_data->dropoff_epsilon, tsdf_data->sparsity_compensation_factor,
-                         &updated_tsdf.voxel.weight, &updated_tsdf.voxel.distance))
-      {
-        // Weight too low. Nothing more to do for this voxel.
-        return true;
-      }
-      // Now try write the value, looping if we fail to write the new value.
-      // mem_fence(CLK_GLOBAL_MEM_FENCE);
-    } while (
-      (updated_tsdf.voxel.distance != initial.voxel.distance || updated_tsdf.voxel.weight != initial.voxel.weight) &&
-      !gputilAtomicCasU64(tsdf_voxel_ptr, initial.value, updated_tsdf.value));
+    updateVoxelTsdf(&tsdf_data->tsdf_voxels[vi], tsdf_data->sensor, tsdf_data->sample, voxel_centre,
+                    tsdf_data->default_truncation_distance, tsdf_data->max_weight, tsdf_data->dropoff_epsilon,
+                    tsdf_data->sparsity_compensation_factor);
   }
 
   return true;
@@ -247,6 +213,7 @@ __device__ bool visitVoxelTsdf(const GpuKey *voxel_key, const GpuKey *start_key,
 /// @param line_count number of lines in @p line_keys and @p local_lines. These come in pairs, so the number of
 /// elements in those arrays is double this value.
 /// @param region_dimensions Specifies the size of any one region in voxels.
+/// @param voxel_order Specifies the order of voxels in region memory. See @c OHM_VOXEL_ORDER_ROW_MAJOR .
 /// @param voxel_resolution Specifies the size of a voxel cube.
 /// @param ray_adjustment Specifies the value adjustment to apply to voxels along the line segment leading up to the
 ///     final sample voxel. This should be < 0 to re-enforce as free.
@@ -260,7 +227,7 @@ __kernel void tsdfRayUpdate(__global VoxelTsdf *tsdf_voxels, __global ulonglong
                             __global int3 *tsdf_region_keys_global, uint region_count,                            //
                             __global GpuKey *line_keys, __global float3 *local_lines,                             //
                             __global float3 *unclipped_lines, uint line_count,                                    //
-                            int3 region_dimensions, float voxel_resolution, float max_weight,
+                            int3 region_dimensions, uint voxel_order, float voxel_resolution, float max_weight,
                             float default_truncation_distance, float dropoff_epsilon,
                             float sparsity_compensation_factor, uint region_update_flags)
 {
@@ -275,6 +242,7 @@ __kernel void tsdfRayUpdate(__global VoxelTsdf *tsdf_voxels, __global ulonglong
   tsdf_data.tsdf_offsets = tsdf_region_mem_offsets_global;
   tsdf_data.region_keys = tsdf_region_keys_global;
   tsdf_data.region_dimensions = region_dimensions;
+  tsdf_data.voxel_order = voxel_order;
   tsdf_data.voxel_resolution = voxel_resolution;
   tsdf_data.max_weight = max_weight;
   tsdf_data.default_truncation_distance = default_truncation_distance;
@@ -0,0 +1,71 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+/// Update the TSDF voxel at @p tsdf_voxel for a ray from @p sensor to @p sample using a compare and swap loop.
+///
+/// The @p sensor, @p sample and @p voxel_centre are all in a frame local to the centre of the voxel containing the
+/// sample. The remaining arguments are as for @c calculateTsdf() .
+///
+/// Requires 64-bit atomics: @c GPUTIL_ATOMICS_64 .
+/// @param tsdf_voxel The TSDF voxel to update.
+/// @param sensor The ray sensor position.
+/// @param sample The ray sample position.
+/// @param voxel_centre Centre of the voxel to update.
+__device__ void updateVoxelTsdf(__global VoxelTsdf *tsdf_voxel, float3 sensor, float3 sample, float3 voxel_centre,
+                                float default_truncation_distance, float max_weight, float dropoff_epsilon,
+                                float sparsity_compensation_factor);
+
+#ifndef TSDF_VOXEL_CL
+#define TSDF_VOXEL_CL
+
+inline __device__ void updateVoxelTsdf(__global VoxelTsdf *tsdf_voxel, float3 sensor, float3 sample,
+                                       float3 voxel_centre, float default_truncation_distance, float max_weight,
+                                       float dropoff_epsilon, float sparsity_compensation_factor)
+{
+#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
+  // Under high contension we can end up repeatedly failing to write the voxel value.
+  // The primary concern is not deadlocking the GPU, so we put a hard limit on the numebr of
+  // attempts made.
+  const int iteration_limit = 20;
+  int iterations = 0;
+#endif
+
+  /// Use a union of VoxelTsdf and atomic_ulong (64-bits) so we can write the value back in one operation.
+  union
+  {
+    VoxelTsdf voxel;
+    ulonglong value;
+  } initial, updated_tsdf;
+
+  __global atomic_ulong *tsdf_voxel_ptr = (__global atomic_ulong *)tsdf_voxel;
+
+  do
+  {
+#ifdef LIMIT_VOXEL_WRITE_ITERATIONS
+    if (iterations++ > iteration_limit)
+    {
+      break;
+    }
+#endif  // LIMIT_VOXEL_WRITE_ITERATIONS
+
+    initial.value = gputilAtomicLoadU64(tsdf_voxel_ptr);
+    updated_tsdf.voxel.weight = initial.voxel.weight;
+    updated_tsdf.voxel.distance = initial.voxel.distance;
+
+    if (!calculateTsdf(sensor, sample, voxel_centre, default_truncation_distance, max_weight, dropoff_epsilon,
+                       sparsity_compensation_factor, &updated_tsdf.voxel.weight, &updated_tsdf.voxel.distance))
+    {
+      // Weight too low. Nothing more to do for this voxel.
+      return;
+    }
+    // Now try write the value, looping if we fail to write the new value.
+    // mem_fence(CLK_GLOBAL_MEM_FENCE);
+  } while (
+    (updated_tsdf.voxel.distance != initial.voxel.distance || updated_tsdf.voxel.weight != initial.voxel.weight) &&
+    !gputilAtomicCasU64(tsdf_voxel_ptr, initial.value, updated_tsdf.value));
+}
+
+#endif  // TSDF_VOXEL_CL
@@ -12,6 +12,9 @@
 
 #include "RoiRangeFill.h"
 
+#include <ohm/RegionScheduler.h>
+#include <ohm/RoiRangeFillCpu.h>
+
 #include <memory>
 
 // #define CACHE_LOCAL_RESULTS
@@ -32,8 +35,13 @@ struct ClearanceProcessDetail
   /// Last value of the @c OccupancyMap::stamp(). Used to see if the cache needs to be cleared.
   uint64_t map_stamp = 0;
   float search_radius = 0;
+  /// Maximum number of regions to collect for a single GPU @c RoiRangeFill::calculateForRegions() batch.
+  size_t gpu_batch_size = 64;
 
   std::unique_ptr<RoiRangeFill> gpu_query;
+  std::unique_ptr<RoiRangeFillCpu> cpu_query;
+  /// Prioritised region work queue. Used in place of the dirty cursor when a reference position is set.
+  RegionScheduler scheduler;
 
   inline bool haveWork() const
   {
@@ -46,6 +54,7 @@ struct ClearanceProcessDetail
     min_dirty_region = glm::i16vec3(1);
     max_dirty_region = current_dirty_cursor = glm::i16vec3(0);
     map_stamp = 0;
+    scheduler.clear();
   }
 
   void stepCursor(const glm::i16vec3 &step = glm::i16vec3(1));
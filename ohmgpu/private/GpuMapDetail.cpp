@@ -9,6 +9,7 @@
 #include "GpuLayerCacheParams.h"
 #include "GpuMap.h"
 #include "GpuTransformSamples.h"
+#include "OhmGpu.h"
 
 #include <logutil/LogUtil.h>
 
@@ -33,20 +34,43 @@ void onOccupancyLayerChunkSync(MapChunk *chunk, const glm::u8vec3 &region_dimens
 
 GpuMapDetail::~GpuMapDetail()
 {
+  delete transform_samples;
   if (!borrowed_map)
   {
     delete map;
   }
 }
 
+size_t GpuMapDetail::batchMemorySize() const
+{
+  size_t size = 0;
+  for (unsigned i = 0; i < kMaxBuffersCount; ++i)
+  {
+    for (const gputil::Buffer *buffer :
+         { &key_buffers[i], &ray_buffers[i], &original_ray_buffers[i], &intensities_buffers[i], &timestamps_buffers[i],
+           &region_key_buffers[i], &dirty_span_buffers[i] })
+    {
+      size += (buffer->isValid()) ? buffer->actualSize() : 0u;
+    }
+  }
+  return size;
+}
+
+
 GpuCache *initialiseGpuCache(OccupancyMap &map, size_t target_gpu_mem_size, unsigned flags)
+{
+  return initialiseGpuCache(map, ohm::gpuDevice(), target_gpu_mem_size, flags);
+}
+
+
+GpuCache *initialiseGpuCache(OccupancyMap &map, const gputil::Device &gpu, size_t target_gpu_mem_size, unsigned flags)
 {
   OccupancyMapDetail *detail = map.detail();
   auto *gpu_cache = static_cast<GpuCache *>(detail->gpu_cache);
   if (!gpu_cache)
   {
     target_gpu_mem_size = (target_gpu_mem_size) ? target_gpu_mem_size : GpuCache::kDefaultTargetMemSize;
-    gpu_cache = new GpuCache(map, target_gpu_mem_size, flags);
+    gpu_cache = new GpuCache(map, gpu, target_gpu_mem_size, flags);
     detail->gpu_cache = gpu_cache;
 
     reinitialiseGpuCache(gpu_cache, map, flags);
@@ -64,20 +88,34 @@ void reinitialiseGpuCache(GpuCache *gpu_cache, OccupancyMap &map, unsigned flags
     gpu_cache->removeLayers();
 
     // Create default layers.
-    unsigned mappable_flag = 0;
-    if (flags & gpumap::kGpuForceMappedBuffers)
+    unsigned cache_flags = 0;
+    if ((flags & gpumap::kGpuUnifiedMemory) && gpu_cache->gpu().unifiedMemory())
     {
-      mappable_flag |= kGcfMappable;
+      cache_flags |= kGcfUnified;
+    }
+    else if (flags & gpumap::kGpuForceMappedBuffers)
+    {
+      cache_flags |= kGcfMappable;
     }
     else if (flags & gpumap::kGpuAllowMappedBuffers)
     {
       // Use mapped buffers if device has unified host memory.
       if (gpu_cache->gpu().unifiedMemory())
       {
-        mappable_flag |= kGcfMappable;
+        cache_flags |= kGcfMappable;
       }
     }
 
+    if (flags & gpumap::kGpuRegionTable)
+    {
+      cache_flags |= kGcfRegionTable;
+    }
+
+    if (flags & gpumap::kGpuResident)
+    {
+      cache_flags |= kGcfResident;
+    }
+
     // Setup known layers.
     const int occupancy_layer = map.layout().occupancyLayer();
     const int mean_layer = map.layout().meanLayer();
@@ -89,9 +127,10 @@ void reinitialiseGpuCache(GpuCache *gpu_cache, OccupancyMap &map, unsigned flags
     const int touch_times_layer = map.layout().layerIndex(default_layer::touchTimeLayerName());
     const int incidents_layer = map.layout().layerIndex(default_layer::incidentNormalLayerName());
     const int tsdf_layer = map.layout().layerIndex(default_layer::tsdfLayerName());
-    std::array<int, 10> known_layers = { occupancy_layer, mean_layer,      covariance_layer, intensity_layer,
-                                         hit_miss_layer,  clearance_layer, traversal_layer,  touch_times_layer,
-                                         incidents_layer, tsdf_layer };
+    const int secondary_samples_layer = map.layout().layerIndex(default_layer::secondarySamplesLayerName());
+    std::array<int, 11> known_layers = { occupancy_layer,   mean_layer,      covariance_layer, intensity_layer,
+                                         hit_miss_layer,    clearance_layer, traversal_layer,  touch_times_layer,
+                                         incidents_layer,   tsdf_layer,      secondary_samples_layer };
 
     // Calculate the relative layer memory sizes.
     std::map<int, size_t> layer_mem_weight;
@@ -133,17 +172,23 @@ void reinitialiseGpuCache(GpuCache *gpu_cache, OccupancyMap &map, unsigned flags
     {
       if (occupancy_layer >= 0)
       {
+        unsigned occupancy_flags = kGcfRead | kGcfWrite | cache_flags;
+        // Packed occupancy is not supported by the NDT update kernels.
+        if ((flags & gpumap::kGpuPackedOccupancy) && covariance_layer < 0)
+        {
+          occupancy_flags |= kGcfPackedOccupancy;
+        }
         gpu_cache->createCache(kGcIdOccupancy,
                                // On sync, ensure the first valid voxel is updated.
                                GpuLayerCacheParams{ layer_mem_weight[occupancy_layer], occupancy_layer,
-                                                    kGcfRead | kGcfWrite | mappable_flag, &onOccupancyLayerChunkSync });
+                                                    occupancy_flags, &onOccupancyLayerChunkSync });
       }
 
       // Initialise the voxel mean layer.
       if (mean_layer >= 0)
       {
         gpu_cache->createCache(kGcIdVoxelMean, GpuLayerCacheParams{ layer_mem_weight[mean_layer], mean_layer,
-                                                                    kGcfRead | kGcfWrite | mappable_flag });
+                                                                    kGcfRead | kGcfWrite | cache_flags });
       }
 
       if (covariance_layer >= 0)
@@ -151,21 +196,21 @@ void reinitialiseGpuCache(GpuCache *gpu_cache, OccupancyMap &map, unsigned flags
         // TODO(KS): add the write flag if we move to being able to process the samples on GPU too.
         gpu_cache->createCache(kGcIdCovariance,
                                GpuLayerCacheParams{ layer_mem_weight[covariance_layer], covariance_layer,
-                                                    kGcfRead | kGcfWrite | mappable_flag });
+                                                    kGcfRead | kGcfWrite | cache_flags });
       }
 
       // Intensity mean and covaraince.
       if (intensity_layer >= 0)
       {
         gpu_cache->createCache(kGcIdIntensity, GpuLayerCacheParams{ layer_mem_weight[intensity_layer], intensity_layer,
-                                                                    kGcfRead | kGcfWrite | mappable_flag });
+                                                                    kGcfRead | kGcfWrite | cache_flags });
       }
 
       // Ndt-tm hit/miss count
       if (hit_miss_layer >= 0)
       {
         gpu_cache->createCache(kGcIdHitMiss, GpuLayerCacheParams{ layer_mem_weight[hit_miss_layer], hit_miss_layer,
-                                                                  kGcfRead | kGcfWrite | mappable_flag });
+                                                                  kGcfRead | kGcfWrite | cache_flags });
       }
 
       // Note: we create the clearance gpu cache if we have a clearance layer, but it caches the occupancy_layer as that
@@ -175,34 +220,41 @@ void reinitialiseGpuCache(GpuCache *gpu_cache, OccupancyMap &map, unsigned flags
         // Use of occupancy_layer below is correct. See the comment on the kGcIdClearance delcaration and the brief note
         // above.
         gpu_cache->createCache(kGcIdClearance, GpuLayerCacheParams{ layer_mem_weight[clearance_layer], occupancy_layer,
-                                                                    kGcfRead | mappable_flag });
+                                                                    kGcfRead | cache_flags });
       }
 
       if (traversal_layer >= 0)
       {
         gpu_cache->createCache(kGcIdTraversal, GpuLayerCacheParams{ layer_mem_weight[traversal_layer], traversal_layer,
-                                                                    kGcfRead | kGcfWrite | mappable_flag });
+                                                                    kGcfRead | kGcfWrite | cache_flags });
       }
 
       if (touch_times_layer >= 0)
       {
         gpu_cache->createCache(kGcIdTouchTime,
                                GpuLayerCacheParams{ layer_mem_weight[touch_times_layer], touch_times_layer,
-                                                    kGcfRead | kGcfWrite | mappable_flag });
+                                                    kGcfRead | kGcfWrite | cache_flags });
       }
 
       if (incidents_layer >= 0)
       {
         gpu_cache->createCache(kGcIdIncidentNormal,
                                GpuLayerCacheParams{ layer_mem_weight[incidents_layer], incidents_layer,
-                                                    kGcfRead | kGcfWrite | mappable_flag });
+                                                    kGcfRead | kGcfWrite | cache_flags });
       }
 
       if (tsdf_layer >= 0)
       {
         gpu_cache->createCache(kGcIdTsdf,
                                GpuLayerCacheParams{ layer_mem_weight[tsdf_layer], tsdf_layer,
-                                                    kGcfRead | kGcfWrite | mappable_flag, &onOccupancyLayerChunkSync });
+                                                    kGcfRead | kGcfWrite | cache_flags, &onOccupancyLayerChunkSync });
+      }
+
+      if (secondary_samples_layer >= 0)
+      {
+        gpu_cache->createCache(kGcIdSecondarySample,
+                               GpuLayerCacheParams{ layer_mem_weight[secondary_samples_layer], secondary_samples_layer,
+                                                    kGcfRead | kGcfWrite | cache_flags });
       }
     }
     catch (const gputil::ApiException &exception)
@@ -9,6 +9,9 @@
 #include "OhmGpuConfig.h"
 
 #include "GpuCache.h"
+#include "GpuKey.h"
+#include "GpuMapSnapshot.h"
+#include "GpuMemoryArbiter.h"
 #include "RayItem.h"
 
 #include <ohm/Key.h>
@@ -17,6 +20,7 @@
 #include <glm/glm.hpp>
 
 #include <gputil/gpuBuffer.h>
+#include <gputil/gpuDevice.h>
 #include <gputil/gpuEvent.h>
 #include <gputil/gpuKernel.h>
 #include <gputil/gpuPinnedBuffer.h>
@@ -33,6 +37,9 @@
 #endif  // __GNUC__
 
 #include <array>
+#include <functional>
+#include <memory>
+#include <utility>
 #include <vector>
 
 namespace ohm
@@ -40,6 +47,7 @@ namespace ohm
 class OccupancyMap;
 class GpuProgramRef;
 class GpuTransformSamples;
+struct GpuDirtySpanSet;
 
 /// Tracks information about voxel data being uploaded.
 struct VoxelUploadInfo
@@ -77,17 +85,24 @@ struct GpuMapDetail
 {
   using RegionSet = ska::bytell_hash_set<glm::i16vec3, Vector3Hash<glm::i16vec3>>;
 
-  static const unsigned kBuffersCount = 2;
+  /// Maximum number of buffer sets, hence the maximum number of ray batches which may be in flight. The number in use
+  /// is set by @c buffers_count .
+  static const unsigned kMaxBuffersCount = 4;
+  /// Default value for @c buffers_count : double buffering.
+  static const unsigned kDefaultBuffersCount = 2;
+  /// Log2 of the number of slots in the local memory voxel aggregation table used by the aggregate update kernel. Must
+  /// match @c REGION_AGGREGATE_SLOT_BITS in RegionUpdate.cl.
+  static const unsigned kAggregateSlotBits = 9;
   OccupancyMap *map;
   // Ray/key buffer upload event pairs.
   /// Events for @p key_buffers
-  std::array<gputil::Event, kBuffersCount> key_upload_events;
+  std::array<gputil::Event, kMaxBuffersCount> key_upload_events;
   /// Buffers for start/end voxel keys for each ray pair: GpuKey
-  std::array<gputil::Buffer, kBuffersCount> key_buffers;
+  std::array<gputil::Buffer, kMaxBuffersCount> key_buffers;
   /// Events for @p ray_buffers
-  std::array<gputil::Event, kBuffersCount> ray_upload_events;
+  std::array<gputil::Event, kMaxBuffersCount> ray_upload_events;
   /// Buffers of rays to process float3 pairs. Coordinates are local to the centre of the start voxel for each pair.
-  std::array<gputil::Buffer, kBuffersCount> ray_buffers;
+  std::array<gputil::Buffer, kMaxBuffersCount> ray_buffers;
   /// Buffers holding only sample points for each ray in @p ray_buffers. Occupancy algorithms do not need this
   /// information only the current voxel and whether it's the sample voxelor not  - flagged in the key_buffers -
   /// are important. However, algorithms such as TSDF need to know the distance to the final sample point. We may
@@ -96,41 +111,88 @@ struct GpuMapDetail
   /// one item per ray. The coordinates uploaded are relative to the corresponding ray end voxel (second item in each
   /// ray/voxel pair), using the voxel centre as the local origin. For unclipped rays, this will be the same as the end
   /// point.
-  std::array<gputil::Buffer, kBuffersCount> original_ray_buffers;
+  std::array<gputil::Buffer, kMaxBuffersCount> original_ray_buffers;
   /// Events for @p original_ray_buffers
-  std::array<gputil::Event, kBuffersCount> original_ray_upload_events;
+  std::array<gputil::Event, kMaxBuffersCount> original_ray_upload_events;
   /// Buffers to upload sample intensities - a single floating point value per sample.
-  std::array<gputil::Buffer, kBuffersCount> intensities_buffers;
+  std::array<gputil::Buffer, kMaxBuffersCount> intensities_buffers;
   /// Events for @p intensities_buffers
-  std::array<gputil::Event, kBuffersCount> intensities_upload_events;
+  std::array<gputil::Event, kMaxBuffersCount> intensities_upload_events;
   /// Buffers to upload sample timestamps - a uint32 value per sample - quantised, relative time.
-  std::array<gputil::Buffer, kBuffersCount> timestamps_buffers;
+  std::array<gputil::Buffer, kMaxBuffersCount> timestamps_buffers;
   /// Events for @p timestamps_buffers
-  std::array<gputil::Event, kBuffersCount> timestamps_upload_events;
+  std::array<gputil::Event, kMaxBuffersCount> timestamps_upload_events;
 
-  std::array<gputil::Event, kBuffersCount> region_key_upload_events;
-  std::array<gputil::Buffer, kBuffersCount> region_key_buffers;
-  std::array<gputil::Event, kBuffersCount> region_update_events;
+  std::array<gputil::Event, kMaxBuffersCount> region_key_upload_events;
+  std::array<gputil::Buffer, kMaxBuffersCount> region_key_buffers;
+  std::array<gputil::Event, kMaxBuffersCount> region_update_events;
+  /// Buffers of dirty span masks written by the update kernel, one @c uint32_t per region in @c region_key_buffers .
+  /// Only used when @c track_dirty_spans is set.
+  std::array<gputil::Buffer, kMaxBuffersCount> dirty_span_buffers;
+  /// Keys of the regions enqueued in each buffer set, in @c region_key_buffers order. Only populated when
+  /// @c track_dirty_spans is set.
+  std::array<std::vector<glm::i16vec3>, kMaxBuffersCount> batch_region_keys;
 
   // Item 0 is always the occupancy layer.
-  std::array<std::vector<VoxelUploadInfo>, kBuffersCount> voxel_upload_info;
+  std::array<std::vector<VoxelUploadInfo>, kMaxBuffersCount> voxel_upload_info;
   /// Vector used to group/sort rays when @c group_rays is `true`.
   std::vector<RayItem> grouped_rays;
+  /// Sort keys paired with @c grouped_rays indices. Used to sort rays when @c coherent_rays is `true`.
+  std::vector<std::pair<uint64_t, unsigned>> ray_sort_keys;
+  /// Radix sort working buffer for @c ray_sort_keys .
+  std::vector<std::pair<uint64_t, unsigned>> ray_sort_scratch;
+  /// Working buffer used to reorder @c grouped_rays by @c ray_sort_keys .
+  std::vector<RayItem> sorted_rays;
+  /// Input rays after the ray filter pass.
+  std::vector<glm::dvec3> filtered_rays;
+  /// @c RayFilterFlag values for each of the @c filtered_rays .
+  std::vector<unsigned> filter_flags;
+  /// Voxel keys for each of the @c filtered_rays points. See @c OccupancyMap::voxelKeys() .
+  std::vector<Key> filtered_keys;
+  /// GPU sample transformation for @c GpuMap::integrateLocalRays() . Created on first use.
+  GpuTransformSamples *transform_samples = nullptr;
+  /// Region keys touched by the rays from @c transform_samples . May contain duplicates.
+  std::vector<glm::i16vec3> transformed_regions;
+
+  /// Program for @c region_walk_kernel .
+  GpuProgramRef *region_walk_program_ref = nullptr;
+  /// The device @c region_walk_program_ref is referenced for.
+  gputil::Device region_walk_gpu;
+  /// Kernel enumerating the regions touched by a ray batch. Used when @c gpu_region_walk is set.
+  gputil::Kernel region_walk_kernel;
+  /// Hash set used by @c region_walk_kernel to deduplicate region keys.
+  gputil::Buffer region_walk_set;
+  /// Region keys written by @c region_walk_kernel : @c GpuKey .
+  gputil::Buffer region_walk_keys;
+  /// Number of region keys written by @c region_walk_kernel .
+  gputil::Buffer region_walk_count;
+  /// Download buffer for @c region_walk_keys .
+  std::vector<GpuKey> region_walk_results;
 
   GpuProgramRef *program_ref = nullptr;
+  /// The device @c program_ref is referenced for.
+  gputil::Device program_gpu;
   gputil::Kernel update_kernel;
+  /// Occupancy update kernel which aggregates same voxel updates in local memory. See @c GpuMap::setAggregateUpdates()
+  gputil::Kernel aggregate_update_kernel;
 
   RayFilterFunction ray_filter;
+  RayBatchFilterFunction ray_batch_filter;
   bool custom_ray_filter = false;
+  /// Restricts the regions added to @c regions when set. See @c GpuMap::setRegionFilter() .
+  std::function<bool(const glm::i16vec3 &)> region_filter;
 
   /// Number of rays (origin/sample pairs) in the corresponding ray_buffers items.
-  std::array<unsigned, kBuffersCount> ray_counts = { 0, 0 };
+  std::array<unsigned, kMaxBuffersCount> ray_counts{};
   /// Number of rays (origin/sample pairs) in the corresponding ray_buffers items which contain unclipped end (sample)
   /// points.
-  std::array<unsigned, kBuffersCount> unclipped_sample_counts = { 0, 0 };
+  std::array<unsigned, kMaxBuffersCount> unclipped_sample_counts{};
   unsigned transform_count = 0;
-  std::array<unsigned, kBuffersCount> region_counts = { 0, 0 };
+  std::array<unsigned, kMaxBuffersCount> region_counts{};
 
+  /// Number of buffer sets in use. This is the pipeline depth: up to this many ray batches may be in flight, with the
+  /// CPU preparing the next batch while the GPU processes the others. In the range `[2, kMaxBuffersCount]` .
+  unsigned buffers_count = kDefaultBuffersCount;
   int next_buffers_index = 0;
   /// Set of processing regions.
   RegionSet regions;
@@ -153,6 +215,11 @@ struct GpuMapDetail
   unsigned batch_marker = 1;  // Will cycle odd numbers to avoid zero.
   /// Should rays be grouped (sorted) before GPU upload. Should only be set for some algorthims, like NDT (required).
   bool group_rays = false;
+  /// Sort rays by region and direction before GPU upload? Ignored when @c group_rays is set. See
+  /// @c GpuMap::setCoherentRays() .
+  bool coherent_rays = false;
+  /// Enumerate the regions touched by each batch on GPU? See @c GpuMap::setGpuRegionWalk() .
+  bool gpu_region_walk = false;
   /// Should we populate @p original_ray_buffers, storing the unclipped rays points for each ray? See
   /// comments on @p original_ray_buffers.
   bool use_original_ray_buffers = false;
@@ -167,6 +234,37 @@ struct GpuMapDetail
   bool support_voxel_mean = true;
   /// Support traversal GPU cache layer? This is enabled by default, but can be disabled in specific derivations.
   bool support_traversal = true;
+  /// Track the voxel spans modified by the update kernel so only those spans are synchronised back to main memory -
+  /// see @c GpuLayerCache::addDirtySpans() . Only supported by the @c GpuMap occupancy update kernel, so derivations
+  /// which use their own kernels must leave this disabled.
+  bool track_dirty_spans = false;
+  /// Use @c aggregate_update_kernel where supported? See @c GpuMap::setAggregateUpdates() .
+  bool aggregate_updates = false;
+
+  /// Number of elements to accumulate in @c stream_rays before submitting a batch. Zero disables stream batching. See
+  /// @c GpuMap::setStreamBatchSize() .
+  unsigned stream_batch_size = 0;
+  /// @c RayFlag values for the pending @c stream_rays .
+  unsigned stream_flags = 0;
+  /// Origin/sample pairs pending submission in stream batching.
+  std::vector<glm::dvec3> stream_rays;
+  /// Intensity values for @c stream_rays . Only used when @c stream_intensities_valid is set.
+  std::vector<float> stream_intensities;
+  /// Timestamp values for @c stream_rays . Only used when @c stream_timestamps_valid is set.
+  std::vector<double> stream_timestamps;
+  /// Do the pending @c stream_rays have intensity values?
+  bool stream_intensities_valid = false;
+  /// Do the pending @c stream_rays have timestamp values?
+  bool stream_timestamps_valid = false;
+
+  /// Double buffered snapshots for @c GpuMap::syncVoxelsAsync() . A snapshot still held by a caller is replaced
+  /// rather than reused.
+  std::array<std::shared_ptr<GpuMapSnapshot>, 2> snapshots;
+  /// Index of the most recent @c snapshots entry.
+  unsigned snapshot_index = 0;
+
+  /// Registration of the batch buffers with the @c GpuMemoryArbiter . Registered on the first batch.
+  GpuMemoryConsumer memory_consumer;
 
   GpuMapDetail(OccupancyMap *map, bool borrowed_map)
     : map(map)
@@ -174,6 +272,19 @@ struct GpuMapDetail
   {}
 
   virtual ~GpuMapDetail();
+
+  /// Sum the allocated size of the batch buffers across all buffer sets.
+  /// @return The batch buffer GPU memory size in bytes.
+  size_t batchMemorySize() const;
+
+  /// Get the buffer index following @p buffer_index in the pipeline.
+  inline int nextBufferIndex(int buffer_index) const { return (buffer_index + 1) % int(buffers_count); }
+  /// Get the buffer index preceding @p buffer_index in the pipeline. For @c next_buffers_index this is the buffer set
+  /// used by the most recently queued batch.
+  inline int previousBufferIndex(int buffer_index) const
+  {
+    return (buffer_index + int(buffers_count) - 1) % int(buffers_count);
+  }
 };
 
 
@@ -181,6 +292,11 @@ struct GpuMapDetail
 /// @param flags @c GpuFlag values.
 GpuCache *initialiseGpuCache(OccupancyMap &map, size_t target_gpu_mem_size, unsigned flags);
 
+/// @overload
+/// @param gpu The device to create the GPU cache on.
+GpuCache *initialiseGpuCache(OccupancyMap &map, const gputil::Device &gpu, size_t target_gpu_mem_size,
+                             unsigned flags);
+
 
 /// (Re)initialise the given GPU @p gpu_cache to reflect the given @p map layout.
 /// @param flags @c GpuFlag values.
@@ -0,0 +1,97 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_GPUMAPSNAPSHOTDETAIL_H
+#define OHMGPU_GPUMAPSNAPSHOTDETAIL_H
+
+#include "OhmGpuConfig.h"
+
+#include <gputil/gpuEvent.h>
+
+#include <ohmutil/VectorHash.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace ohm
+{
+/// Snapshot of the GPU resident regions for one map layer. Populated by @c GpuLayerCache::snapshot() .
+struct GpuLayerSnapshot
+{
+  /// The @c MapLayout layer index.
+  int layer_index = -1;
+  /// Is the layer part of the current snapshot? Inactive layers are retained to reuse their memory.
+  bool active = false;
+  /// Byte size of each region's voxels in @c gpu_memory .
+  size_t gpu_region_size = 0;
+  /// Byte size of each region's voxels in @c host_memory .
+  size_t host_region_size = 0;
+  /// Number of voxels in each region.
+  size_t region_voxel_count = 0;
+  /// True when @c gpu_memory holds packed occupancy values which must be unpacked to @c host_memory . See
+  /// @c kGcfPackedOccupancy .
+  bool packed = false;
+  /// Maps region keys to their index into the snapshot memory.
+  std::unordered_map<glm::i16vec3, size_t, Vector3Hash<glm::i16vec3>> region_indices;
+  /// Download target memory, @c gpu_region_size bytes per region.
+  std::vector<uint8_t> gpu_memory;
+  /// Unpacked voxel memory when @c packed . Unused otherwise, with @c gpu_memory holding the host voxel data.
+  std::vector<uint8_t> host_memory;
+};
+
+/// Private data for @c GpuMapSnapshot .
+struct GpuMapSnapshotDetail
+{
+  /// Snapshot per synchronised layer.
+  std::vector<GpuLayerSnapshot> layers;
+  /// Completion events for the snapshot downloads.
+  std::vector<gputil::Event> events;
+  /// @c OccupancyMap::stamp() at the time of the snapshot.
+  uint64_t stamp = 0;
+  /// Have the downloads completed and been finalised?
+  bool complete = true;
+
+  /// Resolve the layer snapshot for @p layer_index , reusing an inactive layer entry when available.
+  /// @param layer_index The @c MapLayout layer index.
+  /// @return The layer snapshot, marked active.
+  GpuLayerSnapshot &layer(int layer_index)
+  {
+    for (auto &layer_snapshot : layers)
+    {
+      if (layer_snapshot.layer_index == layer_index)
+      {
+        layer_snapshot.active = true;
+        return layer_snapshot;
+      }
+    }
+    layers.emplace_back();
+    layers.back().layer_index = layer_index;
+    layers.back().active = true;
+    return layers.back();
+  }
+
+  /// Reset for reuse by a new snapshot, retaining allocated memory.
+  void reset()
+  {
+    for (auto &event : events)
+    {
+      event.wait();
+    }
+    events.clear();
+    for (auto &layer_snapshot : layers)
+    {
+      layer_snapshot.active = false;
+      layer_snapshot.region_indices.clear();
+    }
+    stamp = 0;
+    complete = true;
+  }
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_GPUMAPSNAPSHOTDETAIL_H
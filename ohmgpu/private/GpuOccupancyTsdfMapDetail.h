@@ -0,0 +1,33 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef GPUOCCUPANCYTSDFMAPDETAIL_H
+#define GPUOCCUPANCYTSDFMAPDETAIL_H
+
+#include "OhmGpuConfig.h"
+
+#include "private/GpuMapDetail.h"
+
+#include <ohm/VoxelTsdf.h>
+
+namespace ohm
+{
+struct GpuOccupancyTsdfMapDetail : public GpuMapDetail
+{
+  /// Index into @c voxel_upload_info buffers at which we have the @c VoxelUploadInfo for the tsdf layer.
+  int tsdf_uidx = -1;
+  /// Tsdf mapping options.
+  TsdfOptions tsdf_options;
+
+  GpuOccupancyTsdfMapDetail(OccupancyMap *map, bool borrowed_map)
+    : GpuMapDetail(map, borrowed_map)
+  {
+    // Require original samples for TSDF for the distance calculations.
+    use_original_ray_buffers = true;
+  }
+};
+}  // namespace ohm
+
+#endif  // GPUOCCUPANCYTSDFMAPDETAIL_H
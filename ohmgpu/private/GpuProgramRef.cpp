@@ -8,8 +8,28 @@
 
 #include <gputil/gpuKernel.h>
 
+#include <algorithm>
+
 namespace ohm
 {
+namespace
+{
+/// Registry of all @c GpuProgramRef objects, supporting @c GpuProgramRef::warmUp() .
+struct ProgramRegistry
+{
+  std::mutex mutex;
+  std::vector<GpuProgramRef *> programs;
+};
+
+ProgramRegistry &programRegistry()
+{
+  // Function static to ensure construction before any static GpuProgramRef registers.
+  static ProgramRegistry registry;
+  return registry;
+}
+}  // namespace
+
+
 GpuProgramRef::GpuProgramRef(const char *name, SourceType source_type, const char *source_str, size_t source_str_length)
   : name_(name)
   , source_str_(source_str, source_str_length)
@@ -20,6 +40,10 @@ GpuProgramRef::GpuProgramRef(const char *name, SourceType source_type, const cha
   {
     source_str_ = source_str;
   }
+
+  ProgramRegistry &registry = programRegistry();
+  std::unique_lock<std::mutex> guard(registry.mutex);
+  registry.programs.emplace_back(this);
 }
 
 
@@ -34,38 +58,62 @@ GpuProgramRef::GpuProgramRef(const char *name, SourceType source_type, const cha
 GpuProgramRef::~GpuProgramRef()
 {
   releaseReference();
+  ProgramRegistry &registry = programRegistry();
+  std::unique_lock<std::mutex> guard(registry.mutex);
+  registry.programs.erase(std::remove(registry.programs.begin(), registry.programs.end(), this),
+                          registry.programs.end());
+}
+
+
+gputil::Program &GpuProgramRef::program()
+{
+  std::unique_lock<std::mutex> guard(program_mutex_);
+  return (!programs_.empty()) ? programs_.front()->program : null_program_;
+}
+
+
+gputil::Program &GpuProgramRef::program(const gputil::Device &gpu)
+{
+  std::unique_lock<std::mutex> guard(program_mutex_);
+  DeviceProgram *entry = findProgram(gpu);
+  return (entry) ? entry->program : null_program_;
 }
 
 
 bool GpuProgramRef::addReference(gputil::Device &gpu)
 {
   std::unique_lock<std::mutex> guard(program_mutex_);
-  if (program_ref_ == 0)
+  DeviceProgram *entry = findProgram(gpu);
+  if (!entry)
   {
     gputil::BuildArgs build_args;
     ohm::setGpuBuildVersion(build_args);
     build_args.args = &build_args_;
 
     int err = 0;
-    program_ = gputil::Program(gpu, name_.c_str());
+    gputil::Program program(gpu, name_.c_str());
     // Lint(KS): macro may generate the same code, but depends on GPU API.
     if (source_type_ == kSourceFile)  // NOLINT(bugprone-branch-clone)
     {
-      err = GPUTIL_BUILD_FROM_FILE(program_, source_str_.c_str(), build_args);
+      err = GPUTIL_BUILD_FROM_FILE(program, source_str_.c_str(), build_args);
     }
     else
     {
-      err = GPUTIL_BUILD_FROM_SOURCE(program_, source_str_.c_str(), source_str_.size(), build_args);
+      err = GPUTIL_BUILD_FROM_SOURCE(program, source_str_.c_str(), source_str_.size(), build_args);
     }
 
     if (err)
     {
-      program_ = gputil::Program();
       return false;
     }
+
+    programs_.emplace_back(std::make_unique<DeviceProgram>());
+    entry = programs_.back().get();
+    entry->gpu = gpu;
+    entry->program = std::move(program);
   }
 
-  ++program_ref_;
+  ++entry->ref_count;
   return true;
 }
 
@@ -73,14 +121,19 @@ bool GpuProgramRef::addReference(gputil::Device &gpu)
 void GpuProgramRef::releaseReference()
 {
   std::unique_lock<std::mutex> guard(program_mutex_);
+  if (!programs_.empty())
+  {
+    release(programs_.front().get());
+  }
+}
+
 
-  if (program_ref_ > 0)
+void GpuProgramRef::releaseReference(const gputil::Device &gpu)
+{
+  std::unique_lock<std::mutex> guard(program_mutex_);
+  if (DeviceProgram *entry = findProgram(gpu))
   {
-    --program_ref_;
-    if (!program_ref_)
-    {
-      program_ = gputil::Program();
-    }
+    release(entry);
   }
 }
 
@@ -88,6 +141,55 @@ void GpuProgramRef::releaseReference()
 bool GpuProgramRef::isValid()
 {
   std::unique_lock<std::mutex> guard(program_mutex_);
-  return program_ref_ > 0;
+  return !programs_.empty();
+}
+
+
+unsigned GpuProgramRef::warmUp(gputil::Device &gpu)
+{
+  std::vector<GpuProgramRef *> programs;
+  {
+    ProgramRegistry &registry = programRegistry();
+    std::unique_lock<std::mutex> guard(registry.mutex);
+    programs = registry.programs;
+  }
+
+  unsigned failure_count = 0;
+  for (GpuProgramRef *program : programs)
+  {
+    if (program->addReference(gpu))
+    {
+      program->releaseReference(gpu);
+    }
+    else
+    {
+      ++failure_count;
+    }
+  }
+
+  return failure_count;
+}
+
+
+GpuProgramRef::DeviceProgram *GpuProgramRef::findProgram(const gputil::Device &gpu)
+{
+  for (auto &entry : programs_)
+  {
+    if (entry->gpu == gpu)
+    {
+      return entry.get();
+    }
+  }
+  return nullptr;
+}
+
+
+void GpuProgramRef::release(DeviceProgram *entry)
+{
+  if (--entry->ref_count <= 0)
+  {
+    programs_.erase(std::find_if(programs_.begin(), programs_.end(),
+                                 [entry](const std::unique_ptr<DeviceProgram> &item) { return item.get() == entry; }));
+  }
 }
 }  // namespace ohm
@@ -8,16 +8,13 @@
 
 #include "OhmGpuConfig.h"
 
+#include <gputil/gpuDevice.h>
 #include <gputil/gpuProgram.h>
 
+#include <memory>
 #include <mutex>
 #include <vector>
 
-namespace gputil
-{
-class Device;
-}  // namespace gputil
-
 namespace ohm
 {
 /// A helper class for reference counting a gpu program.
@@ -30,6 +27,9 @@ namespace ohm
 ///   - E.g., in the constructor of the file using the program.
 /// - Call release when each reference is done with the program.
 ///   - E.g., in the constructor of the file using the program.
+///
+/// A separate program is built and reference counted for each @c gputil::Device referenced. Code which may run on
+/// devices other than @c gpuDevice() should use the overloads accepting a @c gputil::Device .
 class ohmgpu_API GpuProgramRef
 {
 public:
@@ -62,17 +62,49 @@ public:
                 const std::initializer_list<std::string> &build_args);
   ~GpuProgramRef();
 
-  inline gputil::Program &program() { return program_; }
+  /// Get the program for the first device referenced. Invalid when there are no references.
+  gputil::Program &program();
+  /// Get the program for @p gpu . Invalid when @p gpu is not referenced.
+  gputil::Program &program(const gputil::Device &gpu);
 
+  /// Add a reference to the program for @p gpu , building the program if this is the first reference for @p gpu .
+  /// @return True if the program is valid for @p gpu .
   bool addReference(gputil::Device &gpu);
+  /// Release a reference to the program for the first device referenced.
   void releaseReference();
+  /// Release a reference to the program for @p gpu .
+  void releaseReference(const gputil::Device &gpu);
 
+  /// Is there a valid program for any device?
   bool isValid();
 
+  /// Build the program of every @c GpuProgramRef in the process for @p gpu , without retaining the programs. This
+  /// populates the @c gputil::Device::programCacheDir() binary cache ahead of time so later references load binaries
+  /// rather than compiling. Programs which are already referenced for @p gpu are not rebuilt.
+  /// @param gpu The device to build for.
+  /// @return The number of programs which failed to build.
+  static unsigned warmUp(gputil::Device &gpu);
+
 private:
+  /// Program and reference count for a single device.
+  struct DeviceProgram
+  {
+    gputil::Device gpu;
+    gputil::Program program;
+    int ref_count = 0;
+  };
+
+  /// Find the @c DeviceProgram for @p gpu . Assumes @c program_mutex_ is locked.
+  DeviceProgram *findProgram(const gputil::Device &gpu);
+  /// Release a reference to @p entry , removing it from @c programs_ when the last reference is released. Assumes
+  /// @c program_mutex_ is locked.
+  void release(DeviceProgram *entry);
+
   std::mutex program_mutex_;
-  gputil::Program program_;
-  volatile int program_ref_ = 0;
+  /// Per device programs. Held by pointer to keep @c program() references stable.
+  std::vector<std::unique_ptr<DeviceProgram>> programs_;
+  /// Invalid program returned when there is no program for the requested device.
+  gputil::Program null_program_;
   std::string name_;
   std::string source_str_;
   SourceType source_type_;
@@ -0,0 +1,29 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef GPUSECONDARYSAMPLEMAPDETAIL_H
+#define GPUSECONDARYSAMPLEMAPDETAIL_H
+
+#include "OhmGpuConfig.h"
+
+#include "private/GpuMapDetail.h"
+
+namespace ohm
+{
+struct GpuSecondarySampleMapDetail : public GpuMapDetail
+{
+  /// Index into @c voxel_upload_info buffers at which we have the @c VoxelUploadInfo for the secondary sample layer.
+  int secondary_sample_uidx = -1;
+
+  GpuSecondarySampleMapDetail(OccupancyMap *map, bool borrowed_map)
+    : GpuMapDetail(map, borrowed_map)
+  {
+    // The update kernel requires samples grouped by voxel.
+    group_rays = true;
+  }
+};
+}  // namespace ohm
+
+#endif  // GPUSECONDARYSAMPLEMAPDETAIL_H
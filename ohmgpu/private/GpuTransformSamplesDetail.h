@@ -24,5 +24,13 @@ struct GpuTransformSamplesDetail
   std::array<gputil::Event, kUploadEventCount> upload_events;
   gputil::Device gpu;
   gputil::Kernel kernel;
+  /// Kernel for @c GpuTransformSamples::transformRays()
+  gputil::Kernel rays_kernel;
+  /// Sensor frame samples for @c rays_kernel : @c gputil::float4 with time in @c w .
+  gputil::Buffer samples_buffer;
+  /// Ray and region counts written by @c rays_kernel .
+  gputil::Buffer counts_buffer;
+  /// Region keys written by @c rays_kernel .
+  gputil::Buffer regions_buffer;
 };
 }  // namespace ohm
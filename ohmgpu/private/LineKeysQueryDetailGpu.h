@@ -13,9 +13,11 @@
 
 // Include GPU structure definition.
 #include "GpuKey.h"
+#include "GpuMemoryArbiter.h"
 
 #include <gputil/gpuBuffer.h>
 #include <gputil/gpuDevice.h>
+#include <gputil/gpuEvent.h>
 #include <gputil/gpuKernel.h>
 #include <gputil/gpuQueue.h>
 
@@ -32,8 +34,14 @@ struct LineKeysQueryDetailGpu : public LineKeysQueryDetail
 
   gputil::Buffer lines_out;
   gputil::Buffer line_points;
+  /// Caller supplied buffer replacing @c lines_out . Results are not read back when set.
+  gputil::Buffer *output_buffer = nullptr;
   unsigned max_keys_per_line = 0;
+  /// Marks completion of the line keys kernel for the current query.
+  gputil::Event completion_event;
   std::atomic_bool inflight{ false };
+  /// Registration of @c lines_out and @c line_points with the @c GpuMemoryArbiter .
+  GpuMemoryConsumer memory_consumer;
 
   bool gpu_ok = false;
 };
@@ -0,0 +1,41 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMGPU_NEARESTNEIGHBOURSDETAILGPU_H
+#define OHMGPU_NEARESTNEIGHBOURSDETAILGPU_H
+
+#include "OhmGpuConfig.h"
+
+#include <ohm/private/NearestNeighboursBatchDetail.h>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuKernel.h>
+
+namespace ohm
+{
+class GpuProgramRef;
+
+/// Pimpl data for @c NearestNeighboursGpu
+struct NearestNeighboursDetailGpu : NearestNeighboursBatchDetail
+{
+  /// Device for which the @c kernel was created.
+  gputil::Device gpu;
+  gputil::Kernel kernel;
+  GpuProgramRef *program_ref = nullptr;
+  /// Query points for the current batch: @c NearestNeighboursPoint .
+  gputil::Buffer points_gpu;
+  /// Per point region tables for the current batch: GPU cache memory offsets.
+  gputil::Buffer region_offsets_gpu;
+  /// Appended results: @c NearestNeighboursResult .
+  gputil::Buffer results_gpu;
+  /// Number of appended results.
+  gputil::Buffer result_count_gpu;
+  /// Nearest result reduction: two entries per point.
+  gputil::Buffer nearest_gpu;
+};
+}  // namespace ohm
+
+#endif  // OHMGPU_NEARESTNEIGHBOURSDETAILGPU_H
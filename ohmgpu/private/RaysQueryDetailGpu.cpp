@@ -29,6 +29,7 @@
 
 #if GPUTIL_TYPE == GPUTIL_CUDA
 GPUTIL_CUDA_DECLARE_KERNEL(raysQuery);
+GPUTIL_CUDA_DECLARE_KERNEL(raysQueryReduce);
 #endif  // GPUTIL_TYPE == GPUTIL_CUDA
 
 namespace ohm
@@ -54,7 +55,9 @@ RaysQueryMapWrapper::RaysQueryMapWrapper()
 
 
 RaysQueryMapWrapper::~RaysQueryMapWrapper()
-{}
+{
+  RaysQueryMapWrapper::releaseGpuProgram();
+}
 
 
 void RaysQueryMapWrapper::setMap(OccupancyMap *map)
@@ -99,17 +102,44 @@ float RaysQueryMapWrapper::volumeCoefficient() const
 }
 
 
+void RaysQueryMapWrapper::setReduction(unsigned reduce_flags, unsigned group_size)
+{
+  RaysQueryMapWrapperDetail *imp = detail();
+  imp->reduce_flags = (group_size) ? reduce_flags : 0u;
+  imp->reduce_group_size = (reduce_flags) ? group_size : 0u;
+}
+
+
+void RaysQueryMapWrapper::setOutputBuffer(gputil::Buffer *buffer)
+{
+  detail()->output_buffer = buffer;
+}
+
+
 const std::vector<RaysQueryResult> &RaysQueryMapWrapper::results() const
 {
   return detail()->results_cpu;
 }
 
 
+const std::vector<RaysQueryReduceResult> &RaysQueryMapWrapper::reductions() const
+{
+  return detail()->reductions_cpu;
+}
+
+
+const gputil::Event &RaysQueryMapWrapper::resultsEvent() const
+{
+  return detail()->results_event;
+}
+
+
 size_t RaysQueryMapWrapper::integrateRays(const glm::dvec3 *rays, size_t element_count, const float *intensities,
                                           const double *timestamps, unsigned ray_update_flags)
 {
   RaysQueryMapWrapperDetail *imp = detail();
   imp->results_cpu.clear();
+  imp->reductions_cpu.clear();
   imp->needs_sync = true;
   // Queries must be traced forward for the correct result - ray start to end - and cannot be reverse traced.
   return GpuMap::integrateRays(rays, element_count, intensities, timestamps, ray_update_flags & ~kRfReverseWalk);
@@ -154,16 +184,29 @@ void RaysQueryMapWrapper::cacheGpuProgram(bool with_voxel_mean, bool with_traver
   releaseGpuProgram();
 
   GpuCache &gpu_cache = *gpuCache();
+  const GpuLayerCache *occupancy_cache = gpu_cache.layerCache(kGcIdOccupancy);
+  if (occupancy_cache && occupancy_cache->packedOccupancy())
+  {
+    logutil::error("RaysQueryGpu: packed occupancy GPU cache not supported.\n");
+    imp_->gpu_ok = false;
+    return;
+  }
+
   imp_->gpu_ok = true;
   imp_->cached_sub_voxel_program = with_voxel_mean;
   imp_->program_ref = &g_program_ref;
+  imp_->program_gpu = gpu_cache.gpu();
 
-  if (imp_->program_ref->addReference(gpu_cache.gpu()))
+  if (imp_->program_ref->addReference(imp_->program_gpu))
   {
-    imp_->update_kernel = GPUTIL_MAKE_KERNEL(imp_->program_ref->program(), raysQuery);
+    imp_->update_kernel = GPUTIL_MAKE_KERNEL(imp_->program_ref->program(imp_->program_gpu), raysQuery);
     imp_->update_kernel.calculateOptimalWorkGroupSize();
 
-    imp_->gpu_ok = imp_->update_kernel.isValid();
+    RaysQueryMapWrapperDetail *imp = detail();
+    imp->reduce_kernel = GPUTIL_MAKE_KERNEL(imp_->program_ref->program(imp_->program_gpu), raysQueryReduce);
+    imp->reduce_kernel.calculateOptimalWorkGroupSize();
+
+    imp_->gpu_ok = imp_->update_kernel.isValid() && imp->reduce_kernel.isValid();
   }
   else
   {
@@ -172,6 +215,18 @@ void RaysQueryMapWrapper::cacheGpuProgram(bool with_voxel_mean, bool with_traver
 }
 
 
+void RaysQueryMapWrapper::releaseGpuProgram()
+{
+  // Release our kernel before the base class releases the program.
+  RaysQueryMapWrapperDetail *imp = detail();
+  if (imp && imp->reduce_kernel.isValid())
+  {
+    imp->reduce_kernel = gputil::Kernel();
+  }
+  GpuMap::releaseGpuProgram();
+}
+
+
 void RaysQueryMapWrapper::finaliseBatch(unsigned region_update_flags)
 {
   (void)region_update_flags;  // unused
@@ -187,10 +242,18 @@ void RaysQueryMapWrapper::finaliseBatch(unsigned region_update_flags)
   // Enqueue update kernel.
   const gputil::int3 region_dim_gpu = { map->region_voxel_dimensions.x, map->region_voxel_dimensions.y,
                                         map->region_voxel_dimensions.z };
+  const unsigned voxel_order_gpu = unsigned(imp->map->voxelOrder());
 
   const unsigned region_count = imp->region_counts[buf_idx];
   const unsigned ray_count = imp->ray_counts[buf_idx];
-  imp->results_gpu.elementsResize<RaysQueryResult>(ray_count);
+  // Per ray results are written directly to the caller's buffer unless reducing.
+  gputil::Buffer &results_gpu =
+    (imp->output_buffer && !imp->reduce_flags) ? *imp->output_buffer : imp->results_gpu;
+  if (!results_gpu.isValid())
+  {
+    results_gpu = gputil::Buffer(gpu_cache.gpu(), sizeof(RaysQueryResult) * ray_count, gputil::kBfReadWrite);
+  }
+  results_gpu.elementsResize<RaysQueryResult>(ray_count);
   gputil::Dim3 global_size(ray_count);
   gputil::Dim3 local_size(std::min<size_t>(imp->update_kernel.optimalWorkGroupSize(), ray_count));
   gputil::EventList wait(
@@ -205,27 +268,75 @@ void RaysQueryMapWrapper::finaliseBatch(unsigned region_update_flags)
                      gputil::BufferArg<gputil::int3>(imp->region_key_buffers[buf_idx]), region_count,
                      gputil::BufferArg<GpuKey>(imp->key_buffers[buf_idx]),
                      gputil::BufferArg<gputil::float3>(imp->ray_buffers[buf_idx]), ray_count, region_dim_gpu,
-                     float(map->resolution), map->occupancy_threshold_value, imp->volume_coefficient,
-                     gputil::BufferArg<RaysQueryResult>(imp->results_gpu));
+                     voxel_order_gpu, float(map->resolution), map->occupancy_threshold_value, imp->volume_coefficient,
+                     gputil::BufferArg<RaysQueryResult>(results_gpu));
   // gpu_cache.gpuQueue().flush();
 
 
   // Update most recent chunk GPU event.
   occupancy_layer_cache.updateEvents(imp->batch_marker, imp->region_update_events[buf_idx]);
 
-  // Enqueu reading the results.
-  imp->results_cpu.resize(ray_count);
-  imp->results_gpu.readElements(imp->results_cpu.data(), ray_count, 0, &gpu_cache.gpuQueue(),
-                                &imp->region_update_events[buf_idx], &imp->results_event);
+  if (imp->reduce_flags)
+  {
+    // Reduce on GPU, writing to the caller's buffer or our own for readback.
+    const unsigned group_count = (ray_count + imp->reduce_group_size - 1u) / imp->reduce_group_size;
+    gputil::Buffer &reductions_gpu = (imp->output_buffer) ? *imp->output_buffer : imp->reductions_gpu;
+    if (!reductions_gpu.isValid())
+    {
+      reductions_gpu = gputil::Buffer(gpu_cache.gpu(), sizeof(RaysQueryReduceResult) * group_count,
+                                      (imp->output_buffer) ? gputil::kBfReadWrite : gputil::kBfWriteHost);
+    }
+    reductions_gpu.elementsResize<RaysQueryReduceResult>(group_count);
+
+    gputil::Event reduce_event;
+    gputil::Dim3 reduce_global_size(group_count);
+    gputil::Dim3 reduce_local_size(std::min<size_t>(imp->reduce_kernel.optimalWorkGroupSize(), group_count));
+    imp->reduce_kernel(reduce_global_size, reduce_local_size, gputil::EventList({ imp->region_update_events[buf_idx] }),
+                       reduce_event, &gpu_cache.gpuQueue(),
+                       // Kernel args begin:
+                       gputil::BufferArg<RaysQueryResult>(imp->results_gpu), ray_count, imp->reduce_group_size,
+                       imp->reduce_flags, gputil::BufferArg<RaysQueryReduceResult>(reductions_gpu));
+
+    if (imp->output_buffer)
+    {
+      imp->results_event = reduce_event;
+    }
+    else
+    {
+      imp->reductions_cpu.resize(group_count);
+      reductions_gpu.readElements(imp->reductions_cpu.data(), group_count, 0, &gpu_cache.gpuQueue(), &reduce_event,
+                                  &imp->results_event);
+    }
+  }
+  else if (imp->output_buffer)
+  {
+    // The per ray results are complete in the caller's buffer.
+    imp->results_event = imp->region_update_events[buf_idx];
+  }
+  else
+  {
+    // Enqueu reading the results.
+    imp->results_cpu.resize(ray_count);
+    imp->results_gpu.readElements(imp->results_cpu.data(), ray_count, 0, &gpu_cache.gpuQueue(),
+                                  &imp->region_update_events[buf_idx], &imp->results_event);
+  }
 
   gpu_cache.gpuQueue().finish();
 
+  // Report the result buffers we own. The batch buffers are reported by the GpuMap.
+  if (!imp->results_memory.isValid())
+  {
+    imp->results_memory = GpuMemoryConsumer(GpuMemoryArbiter::forDevice(gpu_cache.gpu()), "RaysQueryGpu", 0u, 0u);
+  }
+  imp->results_memory.reportUsage(((imp->results_gpu.isValid()) ? imp->results_gpu.actualSize() : 0u) +
+                                  ((imp->reductions_gpu.isValid()) ? imp->reductions_gpu.actualSize() : 0u));
+
   // logutil::trace(imp->region_counts[buf_idx], "regions\n");
 
   imp->region_counts[buf_idx] = 0;
   // Start a new batch for the GPU layers.
   imp->batch_marker = occupancy_layer_cache.beginBatch();
-  imp->next_buffers_index = 1 - imp->next_buffers_index;
+  imp->next_buffers_index = imp->nextBufferIndex(imp->next_buffers_index);
 }
 
 }  // namespace ohm
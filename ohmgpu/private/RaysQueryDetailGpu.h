@@ -20,6 +20,19 @@ struct RaysQueryMapWrapperDetail : public GpuMapDetail
   gputil::Event results_event;
   gputil::Buffer results_gpu;
   std::vector<RaysQueryResult> results_cpu;
+  /// Kernel reducing @c results_gpu for groups of rays. See @c RaysQueryGpu::setReduction() .
+  gputil::Kernel reduce_kernel;
+  /// Reduced results on GPU when not writing to an @c output_buffer .
+  gputil::Buffer reductions_gpu;
+  std::vector<RaysQueryReduceResult> reductions_cpu;
+  /// Registration of @c results_gpu and @c reductions_gpu with the @c GpuMemoryArbiter .
+  GpuMemoryConsumer results_memory;
+  /// Caller supplied GPU output. Results are not read back to CPU when set.
+  gputil::Buffer *output_buffer = nullptr;
+  /// Reductions to perform: @c RQ_ReduceSum , @c RQ_ReduceMin and @c RQ_ReduceAnyOccupied flags.
+  unsigned reduce_flags = 0;
+  /// Number of rays in each reduction group.
+  unsigned reduce_group_size = 0;
   float volume_coefficient = 1.0f;
   bool needs_sync = false;
 
@@ -48,7 +61,16 @@ public:
   void setVolumeCoefficient(float coefficient);
   float volumeCoefficient() const;
 
+  /// Set the reductions to perform on GPU. See @c RaysQueryGpu::setReduction() .
+  void setReduction(unsigned reduce_flags, unsigned group_size);
+  /// Set the caller supplied GPU output buffer. See @c RaysQueryGpu::setOutputBuffer() .
+  void setOutputBuffer(gputil::Buffer *buffer);
+
   const std::vector<RaysQueryResult> &results() const;
+  const std::vector<RaysQueryReduceResult> &reductions() const;
+
+  /// Event marking completion of the last query, including any readback.
+  const gputil::Event &resultsEvent() const;
 
   using RayMapper::integrateRays;
 
@@ -66,6 +88,8 @@ protected:
   /// Load and cache the required GPU program. The @p with_voxel_mean value is irrelevant.
   void cacheGpuProgram(bool with_voxel_mean, bool with_traversal, bool force) final;
 
+  void releaseGpuProgram() final;
+
   /// Override the GPU kernenel invocation to perform the rays query.
   void finaliseBatch(unsigned region_update_flags) final;
 };
@@ -73,5 +97,13 @@ protected:
 struct RaysQueryDetailGpu : public RaysQueryDetail
 {
   std::unique_ptr<RaysQueryMapWrapper> gpu_interface;
+  /// Caller supplied output buffer. See @c RaysQueryGpu::setOutputBuffer() .
+  gputil::Buffer *output_buffer = nullptr;
+  /// See @c RaysQueryGpu::setReduction() .
+  unsigned reduce_flags = 0;
+  /// See @c RaysQueryGpu::setReduction() .
+  unsigned reduce_group_size = 0;
+  /// True when a GPU query has been started and the results have yet to be synchronised.
+  bool gpu_pending = false;
 };
 }  // namespace ohm
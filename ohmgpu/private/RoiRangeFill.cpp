@@ -48,6 +48,9 @@ GPUTIL_CUDA_DECLARE_KERNEL(seedRegionVoxels);
 GPUTIL_CUDA_DECLARE_KERNEL(seedFromOuterRegions);
 GPUTIL_CUDA_DECLARE_KERNEL(propagateObstacles);
 GPUTIL_CUDA_DECLARE_KERNEL(migrateResults);
+GPUTIL_CUDA_DECLARE_KERNEL(seedChannels);
+GPUTIL_CUDA_DECLARE_KERNEL(propagateChannels);
+GPUTIL_CUDA_DECLARE_KERNEL(migrateChannels);
 #endif  // GPUTIL_TYPE == GPUTIL_CUDA
 
 namespace ohm
@@ -80,6 +83,12 @@ RoiRangeFill::RoiRangeFill(gputil::Device &gpu)
   {
     gpu_work = gputil::Buffer(gpu, 1 * sizeof(gputil::char4), gputil::kBfReadWrite);
   }
+  gpu_region_channels_buffer_ = gputil::Buffer(gpu, 4, gputil::kBfReadHost);
+  for (auto &gpu_work : gpu_channel_work_)
+  {
+    gpu_work = gputil::Buffer(gpu, 1 * sizeof(gputil::char4), gputil::kBfReadWrite);
+  }
+  memory_consumer_ = GpuMemoryConsumer(GpuMemoryArbiter::forDevice(gpu), "ClearanceProcess", 0u, 0u);
 }
 
 
@@ -92,6 +101,10 @@ RoiRangeFill::~RoiRangeFill()
   gpu_region_clearance_buffer_ = gputil::Buffer();
   gpu_work_[0] = gputil::Buffer();
   gpu_work_[1] = gputil::Buffer();
+  gpu_region_channels_buffer_ = gputil::Buffer();
+  gpu_channel_work_[0] = gputil::Buffer();
+  gpu_channel_work_[1] = gputil::Buffer();
+  memory_consumer_.release();
   gpu_ = gputil::Device();
 
   releaseGpuProgram();
@@ -99,6 +112,12 @@ RoiRangeFill::~RoiRangeFill()
 
 
 bool RoiRangeFill::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &region_key)
+{
+  return calculateForRegions(map, &region_key, 1u);
+}
+
+
+bool RoiRangeFill::calculateForRegions(OccupancyMap &map, const glm::i16vec3 *region_keys, size_t region_count)
 {
   PROFILE(RoiRangeFill);
 
@@ -108,36 +127,35 @@ bool RoiRangeFill::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &reg
     return false;
   }
 
+  if (region_count == 0)
+  {
+    return true;
+  }
+
+  channels_layer_ =
+    (calculate_channels_) ? map.layout().layerIndex(default_layer::clearanceChannelsLayerName()) : -1;
+
   PROFILE(prime);
 
-  // Calculate the voxel extents of the query. This size depends on the size of a single region plus the padding
-  // required to ensure we reach the search range.
+  // Calculate the voxel padding for the query. Each block is padded by enough voxels to ensure we reach the search
+  // range.
   const auto voxel_padding = unsigned(std::ceil(search_radius_ / map.resolution()));
 
   // Ensure cache is initialised.
   GpuCache *gpu_cache = initialiseGpuCache(map, GpuCache::kDefaultTargetMemSize, gpumap::kGpuAllowMappedBuffers);
   GpuLayerCache *occupancy_cache = gpu_cache->layerCache(kGcIdOccupancy);
   GpuLayerCache *clearance_cache = gpu_cache->layerCache(kGcIdClearance);
+  if (occupancy_cache->packedOccupancy())
+  {
+    std::cerr << "RoiRangeFill: packed occupancy GPU cache not supported.\n" << std::flush;
+    return false;
+  }
 
-  // // Set the occupancyCache to read only mode. We need to copy query from it, but not back.
-  // // This supports multiple threads.
-  // GpuLayerCacheWriteLock occupancyWriteLock(*occupancyCache);
-
-  // 1. voxelExtents contains the full range of the query.
-  // 2. Determine the optimal buffer size to cover this range. This is based on GPU capabilities.
   const unsigned max_batch_size = std::min(occupancy_cache->cacheSize(), clearance_cache->cacheSize());
   const glm::ivec3 region_padding((voxel_padding + map.regionVoxelDimensions().x - 1) / map.regionVoxelDimensions().x,
                                   (voxel_padding + map.regionVoxelDimensions().y - 1) / map.regionVoxelDimensions().y,
                                   (voxel_padding + map.regionVoxelDimensions().z - 1) / map.regionVoxelDimensions().z);
 
-  // Voxel grid we need to perform the calculations for.
-  const glm::ivec3 batch_calc_extents(map.regionVoxelDimensions());
-  // Voxel grid we need to upload (padded on the calc extents).
-  const glm::ivec3 batch_voxel_extents = batch_calc_extents + 2 * glm::ivec3(voxel_padding);
-  assert(map.regionVoxelDimensions().x <= batch_voxel_extents.x &&
-         map.regionVoxelDimensions().y <= batch_voxel_extents.y &&
-         map.regionVoxelDimensions().z <= batch_voxel_extents.z);
-
   const unsigned required_cache_size = volumeOf(glm::ivec3(1, 1, 1) + 2 * region_padding);
   // Must be able to support uploading 1 region plus enough padding regions to complete the query.
   if (max_batch_size < required_cache_size)
@@ -147,20 +165,102 @@ bool RoiRangeFill::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &reg
     return false;
   }
 
+  // Sort the regions by Z, Y, X so each block can collect its regions from a contiguous range and duplicates can be
+  // removed.
+  std::vector<glm::i16vec3> sorted_keys(region_keys, region_keys + region_count);
+  const auto key_less = [](const glm::i16vec3 &a, const glm::i16vec3 &b) {
+    return (a.z != b.z) ? a.z < b.z : ((a.y != b.y) ? a.y < b.y : a.x < b.x);
+  };
+  std::sort(sorted_keys.begin(), sorted_keys.end(), key_less);
+  sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+
+  glm::ivec3 keys_min(sorted_keys.front());
+  glm::ivec3 keys_max(sorted_keys.front());
+  for (const auto &key : sorted_keys)
+  {
+    keys_min = glm::min(keys_min, glm::ivec3(key));
+    keys_max = glm::max(keys_max, glm::ivec3(key));
+  }
+
+  // Select the block dimensions: as large as the requested extents allow, limited by the maximum block size and by the
+  // GPU cache, which must hold the block and its padding regions.
+  glm::ivec3 block_dim = glm::min(keys_max - keys_min + glm::ivec3(1), glm::ivec3(max_block_regions_));
+  while (volumeOf(block_dim + 2 * region_padding) > max_batch_size)
+  {
+    // Halve the largest axis.
+    int axis = (block_dim.x >= block_dim.y) ? 0 : 1;
+    axis = (block_dim[axis] >= block_dim.z) ? axis : 2;
+    block_dim[axis] = (block_dim[axis] + 1) / 2;
+  }
+
   PROFILE_END(prime);
+
+  bool ok = true;
+  std::vector<glm::i16vec3> block_region_keys;
+  for (int z = keys_min.z; z <= keys_max.z; z += block_dim.z)
+  {
+    for (int y = keys_min.y; y <= keys_max.y; y += block_dim.y)
+    {
+      for (int x = keys_min.x; x <= keys_max.x; x += block_dim.x)
+      {
+        const glm::ivec3 block_min(x, y, z);
+        const glm::ivec3 block_max = glm::min(block_min + block_dim - glm::ivec3(1), keys_max);
+
+        // Collect the requested regions in this block and shrink the block to fit them.
+        block_region_keys.clear();
+        glm::ivec3 used_min = block_max;
+        glm::ivec3 used_max = block_min;
+        for (const auto &key : sorted_keys)
+        {
+          const glm::ivec3 key_coord(key);
+          if (glm::all(glm::greaterThanEqual(key_coord, block_min)) &&
+              glm::all(glm::lessThanEqual(key_coord, block_max)))
+          {
+            block_region_keys.emplace_back(key);
+            used_min = glm::min(used_min, key_coord);
+            used_max = glm::max(used_max, key_coord);
+          }
+        }
+
+        if (!block_region_keys.empty())
+        {
+          ok = calculateForBlock(map, used_min, used_max, region_padding, voxel_padding, block_region_keys) && ok;
+        }
+      }
+    }
+  }
+
+  return ok;
+}
+
+
+bool RoiRangeFill::calculateForBlock(OccupancyMap &map, const glm::ivec3 &block_min, const glm::ivec3 &block_max,
+                                     const glm::ivec3 &region_padding, unsigned voxel_padding,
+                                     const std::vector<glm::i16vec3> &block_region_keys)
+{
   PROFILE(gpuExec);
+  const int clearance_layer_index = map.layout().clearanceLayer();
+  GpuCache *gpu_cache = gpumap::gpuCache(map);
+  GpuLayerCache *occupancy_cache = gpu_cache->layerCache(kGcIdOccupancy);
+  GpuLayerCache *clearance_cache = gpu_cache->layerCache(kGcIdClearance);
+
+  const glm::ivec3 block_dim = block_max - block_min + glm::ivec3(1);
+  // Voxel grid we need to perform the calculations for.
+  const glm::ivec3 working_voxel_extents = block_dim * glm::ivec3(map.regionVoxelDimensions());
+  // Voxel grid we need to upload (padded on the calc extents).
+  const glm::ivec3 batch_voxel_extents = working_voxel_extents + 2 * glm::ivec3(voxel_padding);
+
   std::vector<gputil::Event> upload_events;
   // Iterate the region grid, uploading the batch.
-  const glm::ivec3 region_min = glm::ivec3(region_key) - region_padding;
-  const glm::ivec3 region_max = glm::ivec3(region_key) + region_padding;
+  const glm::ivec3 region_min = block_min - region_padding;
+  const glm::ivec3 region_max = block_max + region_padding;
+  const unsigned upload_region_count = volumeOf(region_max - region_min + glm::ivec3(1));
 
-  // const glm::ivec3 batchMin(x, y, z);
-  // const glm::ivec3 batchMax = batchMin + regionStep - glm::ivec3(1);
   // const unsigned occupancy_batch_marker = occupancy_cache->beginBatch();
   unsigned clearance_batch_marker = clearance_cache->beginBatch();
 
   // Set up the key marking the lower corner of the working group.
-  const Key corner_voxel_key(region_key, glm::u8vec3(0));
+  const Key corner_voxel_key(glm::i16vec3(block_min), glm::u8vec3(0));
   const GpuKey gpu_key = { corner_voxel_key.regionKey().x, corner_voxel_key.regionKey().y,
                            corner_voxel_key.regionKey().z, corner_voxel_key.localKey().x,
                            corner_voxel_key.localKey().y,  corner_voxel_key.localKey().z };
@@ -169,11 +269,16 @@ bool RoiRangeFill::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &reg
   PROFILE(upload);
   // Prepare region key and offset buffers.
   // Size the region buffers.
-  gpu_region_keys_.elementsResize<gputil::int3>(volumeOf(glm::ivec3(1) + 2 * region_padding));
-  gpu_occupancy_region_offsets_.elementsResize<uint64_t>(volumeOf(glm::ivec3(1) + 2 * region_padding));
+  gpu_region_keys_.elementsResize<gputil::int3>(upload_region_count);
+  gpu_occupancy_region_offsets_.elementsResize<uint64_t>(upload_region_count);
 
   gpu_region_clearance_buffer_.resize(
-    map.layout().layer(clearance_layer_index).layerByteSize(map.regionVoxelDimensions()));
+    map.layout().layer(clearance_layer_index).layerByteSize(map.regionVoxelDimensions()) * volumeOf(block_dim));
+  if (channels_layer_ >= 0)
+  {
+    gpu_region_channels_buffer_.resize(
+      map.layout().layer(channels_layer_).layerByteSize(map.regionVoxelDimensions()) * volumeOf(block_dim));
+  }
 
   gputil::PinnedBuffer region_keys(gpu_region_keys_, gputil::kPinWrite);
   gputil::PinnedBuffer occupancy_region_offsets(gpu_occupancy_region_offsets_, gputil::kPinWrite);
@@ -242,11 +347,12 @@ bool RoiRangeFill::calculateForRegion(OccupancyMap &map, const glm::i16vec3 &reg
 
   PROFILE_END(upload)
 
-  // All regions for this patch pushed. Make the calculation.
+  // All regions for this block pushed. Make the calculation.
   // TODO(KS): async unpin.
   region_keys.unpin();
   occupancy_region_offsets.unpin();
-  finishRegion(region_key, map, *this, *gpu_cache, *clearance_cache, batch_voxel_extents, upload_events);
+  finishBlock(block_min, block_max, block_region_keys, map, *this, *gpu_cache, *clearance_cache,
+              working_voxel_extents, batch_voxel_extents, upload_events);
   upload_events.clear();
 
   return true;
@@ -270,9 +376,13 @@ void RoiRangeFill::cacheGpuProgram(bool force)
     seed_outer_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), seedFromOuterRegions);
     propagate_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), propagateObstacles);
     migrate_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), migrateResults);
+    seed_channels_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), seedChannels);
+    propagate_channels_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), propagateChannels);
+    migrate_channels_kernel_ = GPUTIL_MAKE_KERNEL(program_ref_->program(), migrateChannels);
 
     if (!seed_kernel_.isValid() || !seed_outer_kernel_.isValid() || !propagate_kernel_.isValid() ||
-        !migrate_kernel_.isValid())
+        !migrate_kernel_.isValid() || !seed_channels_kernel_.isValid() || !propagate_channels_kernel_.isValid() ||
+        !migrate_channels_kernel_.isValid())
     {
       releaseGpuProgram();
     }
@@ -292,6 +402,10 @@ void RoiRangeFill::cacheGpuProgram(bool force)
       propagate_kernel_.calculateOptimalWorkGroupSize();
 
       migrate_kernel_.calculateOptimalWorkGroupSize();
+
+      seed_channels_kernel_.calculateOptimalWorkGroupSize();
+      propagate_channels_kernel_.calculateOptimalWorkGroupSize();
+      migrate_channels_kernel_.calculateOptimalWorkGroupSize();
     }
   }
 }
@@ -303,6 +417,9 @@ void RoiRangeFill::releaseGpuProgram()
   seed_outer_kernel_ = gputil::Kernel();
   propagate_kernel_ = gputil::Kernel();
   migrate_kernel_ = gputil::Kernel();
+  seed_channels_kernel_ = gputil::Kernel();
+  propagate_channels_kernel_ = gputil::Kernel();
+  migrate_channels_kernel_ = gputil::Kernel();
 
   if (program_ref_)
   {
@@ -311,39 +428,89 @@ void RoiRangeFill::releaseGpuProgram()
 }
 
 
-void RoiRangeFill::finishRegion(const glm::i16vec3 &region_key, OccupancyMap &map, RoiRangeFill &query,
-                                GpuCache &gpu_cache, GpuLayerCache &clearance_cache,
-                                const glm::ivec3 &batch_voxel_extents, const std::vector<gputil::Event> &upload_events)
+void RoiRangeFill::reportMemoryUsage()
+{
+  size_t used = 0;
+  for (const gputil::Buffer *buffer :
+       { &gpu_corner_voxel_key_, &gpu_region_keys_, &gpu_occupancy_region_offsets_, &gpu_region_clearance_buffer_,
+         &gpu_work_[0], &gpu_work_[1], &gpu_region_channels_buffer_, &gpu_channel_work_[0], &gpu_channel_work_[1] })
+  {
+    used += buffer->actualSize();
+  }
+  memory_consumer_.reportUsage(used);
+}
+
+
+void RoiRangeFill::finishBlock(const glm::ivec3 &block_min, const glm::ivec3 &block_max,
+                               const std::vector<glm::i16vec3> &block_region_keys, OccupancyMap &map,
+                               RoiRangeFill &query, GpuCache &gpu_cache, GpuLayerCache &clearance_cache,
+                               const glm::ivec3 &working_voxel_extents, const glm::ivec3 &batch_voxel_extents,
+                               const std::vector<gputil::Event> &upload_events)
 {
-  PROFILE(finishRegion);
+  PROFILE(finishBlock);
 
   PROFILE(invoke);
   // Ensure sufficient working voxel memory size.
   for (int i = 0; i < 2; ++i)
   {
     query.gpuWork(i).elementsResize<gputil::char4>(volumeOf(batch_voxel_extents));
+    if (channels_layer_ >= 0)
+    {
+      // Channels are propagated over the padded working voxels.
+      gpu_channel_work_[i].elementsResize<gputil::char4>(volumeOf(batch_voxel_extents));
+    }
   }
 
-  invoke(*map.detail(), query, gpu_cache, clearance_cache, batch_voxel_extents, upload_events);
+  reportMemoryUsage();
+
+  invoke(*map.detail(), query, gpu_cache, clearance_cache, working_voxel_extents, batch_voxel_extents, upload_events);
   PROFILE_END(invoke);
 
   PROFILE(download);
-  // Download back to main memory.
-  MapChunk *region = map.region(region_key);
-  if (region)
+  // Download back to main memory. The clearance buffer holds each region of the block in turn.
+  const glm::ivec3 block_dim = block_max - block_min + glm::ivec3(1);
+  gputil::PinnedBuffer clearance_buffer(query.gpuRegionClearanceBuffer(), gputil::kPinRead);
+  for (const auto &region_key : block_region_keys)
   {
-    gputil::PinnedBuffer clearance_buffer(query.gpuRegionClearanceBuffer(), gputil::kPinRead);
-    VoxelBuffer<VoxelBlock> voxels(region->voxel_blocks[map.layout().clearanceLayer()]);
-    uint8_t *dst = voxels.voxelMemory();
-    clearance_buffer.read(dst, voxels.voxelMemorySize());
+    MapChunk *region = map.region(region_key);
+    if (region)
+    {
+      const glm::ivec3 block_region = glm::ivec3(region_key) - block_min;
+      const size_t block_region_index = size_t(block_region.x) + size_t(block_region.y) * block_dim.x +
+                                        size_t(block_region.z) * block_dim.x * block_dim.y;
+      VoxelBuffer<VoxelBlock> voxels(region->voxel_blocks[map.layout().clearanceLayer()]);
+      uint8_t *dst = voxels.voxelMemory();
+      clearance_buffer.read(dst, voxels.voxelMemorySize(), block_region_index * voxels.voxelMemorySize());
+    }
+  }
+
+  if (channels_layer_ >= 0)
+  {
+    gputil::PinnedBuffer channels_buffer(gpu_region_channels_buffer_, gputil::kPinRead);
+    for (const auto &region_key : block_region_keys)
+    {
+      MapChunk *region = map.region(region_key);
+      if (region)
+      {
+        const glm::ivec3 block_region = glm::ivec3(region_key) - block_min;
+        const size_t block_region_index = size_t(block_region.x) + size_t(block_region.y) * block_dim.x +
+                                          size_t(block_region.z) * block_dim.x * block_dim.y;
+        VoxelBuffer<VoxelBlock> voxels(region->voxel_blocks[channels_layer_]);
+        channels_buffer.read(voxels.voxelMemory(), voxels.voxelMemorySize(),
+                             block_region_index * voxels.voxelMemorySize());
+        const uint64_t stamp = map.touch();
+        region->touched_stamps[channels_layer_] = stamp;
+        region->markDirty(stamp);
+      }
+    }
   }
   PROFILE_END(download);
 }
 
 
 int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, GpuCache &gpu_cache,
-                         GpuLayerCache &clearance_layer_cache, const glm::ivec3 &input_data_extents,
-                         const std::vector<gputil::Event> &upload_events)
+                         GpuLayerCache &clearance_layer_cache, const glm::ivec3 &working_voxel_extents,
+                         const glm::ivec3 &input_data_extents, const std::vector<gputil::Event> &upload_events)
 {
   int err = 0;
 
@@ -354,10 +521,17 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
   // Region voxel dimensions
   const gputil::int3 region_voxel_extents_gpu = { map.region_voxel_dimensions.x, map.region_voxel_dimensions.y,
                                                   map.region_voxel_dimensions.z };
+  // Working voxel extents: the (non-padded) block of regions being calculated.
+  const gputil::int3 working_extents_gpu = { working_voxel_extents.x, working_voxel_extents.y,
+                                             working_voxel_extents.z };
   // Padding voxel extents from ROI.
-  const gputil::int3 padding_gpu = { (input_data_extents.x - map.region_voxel_dimensions.x) / 2,
-                                     (input_data_extents.y - map.region_voxel_dimensions.y) / 2,
-                                     (input_data_extents.z - map.region_voxel_dimensions.z) / 2 };
+  const gputil::int3 padding_gpu = { (input_data_extents.x - working_voxel_extents.x) / 2,
+                                     (input_data_extents.y - working_voxel_extents.y) / 2,
+                                     (input_data_extents.z - working_voxel_extents.z) / 2 };
+
+  // Order of voxels in region memory.
+  const unsigned voxel_order =
+    unsigned(resolveVoxelOrder(voxelOrderFromFlags(map.flags), glm::ivec3(map.region_voxel_dimensions)));
 
   gputil::float3 axis_scaling_gpu = { query.axisScaling().x, query.axisScaling().y, query.axisScaling().z };
 
@@ -382,10 +556,10 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
   }
 
   int src_buffer_index = 0;
-  // Initial seeding is just a single region extents in X/Y, with Z divided by the batch size (round up to ensure
+  // Initial seeding is just the working extents in X/Y, with Z divided by the batch size (round up to ensure
   // coverage).
-  const gputil::Dim3 seed_grid(size_t(region_voxel_extents_gpu.x), size_t(region_voxel_extents_gpu.y),
-                               size_t((region_voxel_extents_gpu.z + zbatch - 1) / zbatch));
+  const gputil::Dim3 seed_grid(size_t(working_extents_gpu.x), size_t(working_extents_gpu.y),
+                               size_t((working_extents_gpu.z + zbatch - 1) / zbatch));
 
   gputil::Dim3 global_size;
   gputil::Dim3 local_size;
@@ -398,7 +572,7 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
     gputil::BufferArg<gputil::char4>(query.gpuWork(src_buffer_index)),
     gputil::BufferArg<gputil::int3>(query.gpuRegionKeys()),
     gputil::BufferArg<uint64_t>(query.gpuOccupancyRegionOffsets()), query.regionCount(), region_voxel_extents_gpu,
-    region_voxel_extents_gpu, float(map.occupancy_threshold_value), kernel_algorithm_flags, zbatch);
+    voxel_order, working_extents_gpu, float(map.occupancy_threshold_value), kernel_algorithm_flags, zbatch);
   if (err)
   {
     return err;
@@ -406,7 +580,7 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
 
   // Seed from data outside of the ROI.
   const int seed_outer_batch = 32;
-  const size_t padding_volume = volumeOf(input_data_extents) - volumeOf(map.region_voxel_dimensions);
+  const size_t padding_volume = volumeOf(input_data_extents) - volumeOf(working_voxel_extents);
 
   global_size = gputil::Dim3((padding_volume + seed_outer_batch - 1) / seed_outer_batch);
   local_size = gputil::Dim3(256);  // NOLINT(readability-magic-numbers)
@@ -418,7 +592,7 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
     gputil::BufferArg<gputil::char4>(query.gpuWork(src_buffer_index)),
     gputil::BufferArg<gputil::int3>(query.gpuRegionKeys()),
     gputil::BufferArg<uint64_t>(query.gpuOccupancyRegionOffsets()), query.regionCount(), region_voxel_extents_gpu,
-    region_voxel_extents_gpu, padding_gpu, axis_scaling_gpu, float(map.occupancy_threshold_value),
+    voxel_order, working_extents_gpu, padding_gpu, axis_scaling_gpu, float(map.occupancy_threshold_value),
     kernel_algorithm_flags, seed_outer_batch);
 
   if (err)
@@ -426,6 +600,29 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
     return err;
   }
 
+  // Seed the clearance channels over the padded working voxels.
+  const gputil::Dim3 channel_grid(size_t(input_data_extents.x), size_t(input_data_extents.y),
+                                  size_t(input_data_extents.z));
+  const gputil::int3 channel_extents_gpu = { input_data_extents.x, input_data_extents.y, input_data_extents.z };
+  int channel_src_index = 0;
+  gputil::Event channel_event;
+  if (channels_layer_ >= 0)
+  {
+    seed_channels_kernel_.calculateGrid(&global_size, &local_size, channel_grid);
+    err = seed_channels_kernel_(
+      global_size, local_size, channel_event, &queue,
+      // Kernel arguments
+      gputil::BufferArg<GpuKey>(gpu_corner_voxel_key_), gputil::BufferArg<float>(*clearance_layer_cache.buffer()),
+      gputil::BufferArg<gputil::char4>(gpu_channel_work_[channel_src_index]),
+      gputil::BufferArg<gputil::int3>(query.gpuRegionKeys()),
+      gputil::BufferArg<uint64_t>(query.gpuOccupancyRegionOffsets()), query.regionCount(), region_voxel_extents_gpu,
+      voxel_order, channel_extents_gpu, padding_gpu, float(map.occupancy_threshold_value), kernel_algorithm_flags);
+    if (err)
+    {
+      return err;
+    }
+  }
+
   queue.flush();
 
   // #ifdef OHM_PROFILE
@@ -435,9 +632,8 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
 
   PROFILE(propagate);
 
-  propagate_kernel_.calculateGrid(
-    &global_size, &local_size,
-    gputil::Dim3(region_voxel_extents_gpu.x, region_voxel_extents_gpu.y, region_voxel_extents_gpu.z));
+  propagate_kernel_.calculateGrid(&global_size, &local_size,
+                                  gputil::Dim3(working_extents_gpu.x, working_extents_gpu.y, working_extents_gpu.z));
 
   gputil::Event previous_event = seed_outer_kernel_event;
   gputil::Event propagate_event;
@@ -450,7 +646,7 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
                             // Kernel args
                             gputil::BufferArg<gputil::char4>(query.gpuWork(src_buffer_index)),
                             gputil::BufferArg<gputil::char4>(query.gpuWork(1 - src_buffer_index)),
-                            region_voxel_extents_gpu, float(query.searchRadius()), axis_scaling_gpu
+                            working_extents_gpu, float(query.searchRadius()), axis_scaling_gpu
                             // , __local char4 *localVoxels
     );
 
@@ -462,6 +658,27 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
     previous_event = propagate_event;
     src_buffer_index = 1 - src_buffer_index;
 
+    if (channels_layer_ >= 0)
+    {
+      gputil::Dim3 channel_global_size;
+      gputil::Dim3 channel_local_size;
+      propagate_channels_kernel_.calculateGrid(&channel_global_size, &channel_local_size, channel_grid);
+      gputil::Event propagate_channels_event;
+      err = propagate_channels_kernel_(channel_global_size, channel_local_size, { channel_event },
+                                       propagate_channels_event, &queue,
+                                       // Kernel args
+                                       gputil::BufferArg<gputil::char4>(gpu_channel_work_[channel_src_index]),
+                                       gputil::BufferArg<gputil::char4>(gpu_channel_work_[1 - channel_src_index]),
+                                       channel_extents_gpu, axis_scaling_gpu);
+      if (err)
+      {
+        return err;
+      }
+
+      channel_event = propagate_channels_event;
+      channel_src_index = 1 - channel_src_index;
+    }
+
     queue.flush();
   }
 
@@ -477,24 +694,42 @@ int RoiRangeFill::invoke(const OccupancyMapDetail &map, RoiRangeFill &query, Gpu
 
   PROFILE(migrate);
 
-  // Only queue migration kernel for the target region.
-  migrate_kernel_.calculateGrid(
-    &global_size, &local_size,
-    gputil::Dim3(region_voxel_extents_gpu.x, region_voxel_extents_gpu.y, region_voxel_extents_gpu.z));
+  // Only queue migration kernel for the target block.
+  migrate_kernel_.calculateGrid(&global_size, &local_size,
+                                gputil::Dim3(working_extents_gpu.x, working_extents_gpu.y, working_extents_gpu.z));
 
   gputil::Event migrate_event;
   err = migrate_kernel_(global_size, local_size, gputil::EventList({ previous_event }), migrate_event, &queue,
                         // Kernel args
                         gputil::BufferArg<gputil::char4>(query.gpuRegionClearanceBuffer()),
                         gputil::BufferArg<gputil::char4>(query.gpuWork(src_buffer_index)), region_voxel_extents_gpu,
-                        region_voxel_extents_gpu, float(query.searchRadius()), float(map.resolution), axis_scaling_gpu,
-                        unsigned(query.queryFlags()));
+                        voxel_order, working_extents_gpu, float(query.searchRadius()), float(map.resolution),
+                        axis_scaling_gpu, unsigned(query.queryFlags()));
 
   if (err)
   {
     return err;
   }
 
+  if (channels_layer_ >= 0)
+  {
+    migrate_channels_kernel_.calculateGrid(
+      &global_size, &local_size, gputil::Dim3(working_extents_gpu.x, working_extents_gpu.y, working_extents_gpu.z));
+    gputil::Event migrate_channels_event;
+    err = migrate_channels_kernel_(global_size, local_size, gputil::EventList({ channel_event }),
+                                   migrate_channels_event, &queue,
+                                   // Kernel args
+                                   gputil::BufferArg<float>(gpu_region_channels_buffer_),
+                                   gputil::BufferArg<gputil::char4>(gpu_channel_work_[channel_src_index]),
+                                   region_voxel_extents_gpu, voxel_order, working_extents_gpu, padding_gpu,
+                                   float(query.searchRadius()), float(map.resolution), axis_scaling_gpu);
+    if (err)
+    {
+      return err;
+    }
+    migrate_channels_event.wait();
+  }
+
   queue.flush();
 
   previous_event = migrate_event;
@@ -8,13 +8,17 @@
 
 #include "OhmGpuConfig.h"
 
+#include "GpuMemoryArbiter.h"
+
 #include <glm/glm.hpp>
 
 #include <gputil/gpuBuffer.h>
 #include <gputil/gpuDevice.h>
 #include <gputil/gpuKernel.h>
 
+#include <algorithm>
 #include <array>
+#include <vector>
 
 namespace ohm
 {
@@ -57,22 +61,62 @@ public:
   unsigned queryFlags() const { return query_flags_; }
   void setQueryFlags(unsigned flags) { query_flags_ = flags; }
 
+  /// Calculate the @c VoxelClearanceChannels as well as the clearance values? The channels are only calculated when
+  /// the map has a layer named @c default_layer::clearanceChannelsLayerName() - see @c addClearanceChannels() .
+  bool calculateChannels() const { return calculate_channels_; }
+  /// Set whether to calculate the @c VoxelClearanceChannels . The channels are propagated in the same loop as the
+  /// clearance values, over the working voxels plus the search padding.
+  /// @param calculate True to calculate the channels.
+  void setCalculateChannels(bool calculate) { calculate_channels_ = calculate; }
+
   unsigned regionCount() const { return region_count_; }
   // void setRegionCount(unsigned count) { region_count_ = count; }
 
+  /// Maximum number of regions along each axis of a block processed by @c calculateForRegions() .
+  int maxBlockRegions() const { return max_block_regions_; }
+  /// Set the maximum number of regions along each axis of a block processed by @c calculateForRegions() . Larger
+  /// blocks share more padding regions and require fewer dispatches, but need more GPU working memory.
+  /// @param count The block size limit. Clamped to at least 1.
+  void setMaxBlockRegions(int count) { max_block_regions_ = std::max(count, 1); }
+
+  /// Calculate clearance values for a single region.
+  /// @param map The map to calculate clearance values in.
+  /// @param region_key The region to calculate for.
+  /// @return True on success.
   bool calculateForRegion(OccupancyMap &map, const glm::i16vec3 &region_key);
 
+  /// Calculate clearance values for a set of regions in as few GPU dispatches as possible.
+  ///
+  /// The regions are grouped into blocks of up to @c maxBlockRegions() along each axis, limited by the GPU cache size.
+  /// Each block is seeded, propagated and migrated as a single working volume, so the padding regions are uploaded
+  /// once per block rather than once per region and the propagation loop runs once per block. Regions within the
+  /// bounds of a block, but not in @p region_keys , are calculated, but their results are not written to the map.
+  ///
+  /// @param map The map to calculate clearance values in.
+  /// @param region_keys The regions to calculate for. Duplicates are ignored.
+  /// @param region_count Number of elements in @p region_keys .
+  /// @return True on success.
+  bool calculateForRegions(OccupancyMap &map, const glm::i16vec3 *region_keys, size_t region_count);
+
 private:
   void cacheGpuProgram(bool force);
   void releaseGpuProgram();
 
-  void finishRegion(const glm::i16vec3 &region_key, OccupancyMap &map, RoiRangeFill &query, GpuCache &gpu_cache,
-                    GpuLayerCache &clearance_cache, const glm::ivec3 &batch_voxel_extents,
-                    const std::vector<gputil::Event> &upload_events);
+  bool calculateForBlock(OccupancyMap &map, const glm::ivec3 &block_min, const glm::ivec3 &block_max,
+                         const glm::ivec3 &region_padding, unsigned voxel_padding,
+                         const std::vector<glm::i16vec3> &block_region_keys);
+
+  /// Report the size of the working buffers to the @c GpuMemoryArbiter .
+  void reportMemoryUsage();
+
+  void finishBlock(const glm::ivec3 &block_min, const glm::ivec3 &block_max,
+                   const std::vector<glm::i16vec3> &block_region_keys, OccupancyMap &map, RoiRangeFill &query,
+                   GpuCache &gpu_cache, GpuLayerCache &clearance_cache, const glm::ivec3 &working_voxel_extents,
+                   const glm::ivec3 &batch_voxel_extents, const std::vector<gputil::Event> &upload_events);
 
   int invoke(const OccupancyMapDetail &map, RoiRangeFill &query, GpuCache &gpu_cache,
-             GpuLayerCache &clearance_layer_cache, const glm::ivec3 &input_data_extents,
-             const std::vector<gputil::Event> &upload_events);
+             GpuLayerCache &clearance_layer_cache, const glm::ivec3 &working_voxel_extents,
+             const glm::ivec3 &input_data_extents, const std::vector<gputil::Event> &upload_events);
 
   /// Key for the lower extents corner of the global work group. All other GPU threads can resolve their key by
   /// adjusting this key using their 3D global ID.
@@ -81,20 +125,33 @@ private:
   gputil::Buffer gpu_region_keys_;
   /// Memory offsets into the GPU cache memory holding voxel occupancy values. Order matches @c gpu_region_keys_.
   gputil::Buffer gpu_occupancy_region_offsets_;
-  /// Buffer holding the clearance values for the region we are working on.
+  /// Buffer holding the clearance values for the block of regions we are working on.
   gputil::Buffer gpu_region_clearance_buffer_;
   /// Buffer of int4 used to propagate obstacles.
   std::array<gputil::Buffer, 2> gpu_work_;
+  /// Buffer holding the clearance channel values for the block of regions we are working on.
+  gputil::Buffer gpu_region_channels_buffer_;
+  /// Buffers of char4 used to propagate the clearance channels over the padded working voxels.
+  std::array<gputil::Buffer, 2> gpu_channel_work_;
+  /// Registration of the working buffers with the @c GpuMemoryArbiter .
+  GpuMemoryConsumer memory_consumer_;
   gputil::Device gpu_;
   gputil::Kernel seed_kernel_;
   gputil::Kernel seed_outer_kernel_;
   gputil::Kernel propagate_kernel_;
   gputil::Kernel migrate_kernel_;
+  gputil::Kernel seed_channels_kernel_;
+  gputil::Kernel propagate_channels_kernel_;
+  gputil::Kernel migrate_channels_kernel_;
   GpuProgramRef *program_ref_ = nullptr;
   glm::vec3 axis_scaling_ = glm::vec3(1.0f);
   float search_radius_ = 0.0f;
   unsigned query_flags_ = 0;
   unsigned region_count_ = 0;
+  int max_block_regions_ = 4;
+  /// Clearance channels layer index for the current calculation. -1 when not calculating channels.
+  int channels_layer_ = -1;
+  bool calculate_channels_ = false;
 };
 }  // namespace ohm
 
@@ -0,0 +1,169 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ConcurrentPlaneFillLayeredWalker.h"
+
+#include "HeightmapUtil.h"
+
+#include <ohm/Key.h>
+#include <ohm/OccupancyMap.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace ohm
+{
+ConcurrentPlaneFillLayeredWalker::ConcurrentPlaneFillLayeredWalker(const OccupancyMap &map, const Key &min_ext_key,
+                                                                   const Key &max_ext_key, UpAxis up_axis)
+  : map(map)
+  , range(KeyRange(min_ext_key, max_ext_key, map))
+  , key_range(map.rangeBetween(min_ext_key, max_ext_key) + glm::ivec3(1, 1, 1))
+  , axis_indices(ohm::heightmap::heightmapAxisIndices(up_axis))
+  , up_sign((int(up_axis) >= 0) ? 1 : -1)
+{}
+
+
+bool ConcurrentPlaneFillLayeredWalker::begin(Key &key)
+{
+  // Clear existing data.
+  touched_grid_.clear();
+  for (auto &stripe : stripes_)
+  {
+    stripe.touched.clear();
+  }
+  walk_order_.clear();
+  walk_next_ = 0;
+
+  if (range.isValid())
+  {
+    // Size the 2D grid (fixed size)
+    touched_grid_.resize(size_t(key_range[axis_indices[0]]) * size_t(key_range[axis_indices[1]]));
+    std::fill(touched_grid_.begin(), touched_grid_.end(), 0u);
+
+    // Ensure the key is in range.
+    key.clampTo(range.minKey(), range.maxKey());
+
+    return true;
+  }
+
+  return false;
+}
+
+
+size_t ConcurrentPlaneFillLayeredWalker::touchNeighbours(const Key &key, PlaneWalkVisitMode mode,
+                                                         std::array<Key, 8> &neighbours)
+{
+  size_t added = 0;
+  if (mode != PlaneWalkVisitMode::kIgnoreNeighbours)
+  {
+    for (int row_delta = -1; row_delta <= 1; ++row_delta)
+    {
+      for (int col_delta = -1; col_delta <= 1; ++col_delta)
+      {
+        Key n_key = key;
+        map.moveKeyAlongAxis(n_key, axis_indices[1], row_delta);
+        map.moveKeyAlongAxis(n_key, axis_indices[0], col_delta);
+
+        const auto idx = gridIndexForKey(n_key);
+        if (idx != ~0u && (row_delta != 0 || col_delta != 0))
+        {
+          if (touch(idx, keyHeight(n_key), mode == PlaneWalkVisitMode::kAddUnvisitedColumnNeighbours))
+          {
+            assert(added < neighbours.size());
+            neighbours[added] = n_key;
+            ++added;
+          }
+        }
+      }
+    }
+  }
+
+  return added;
+}
+
+
+void ConcurrentPlaneFillLayeredWalker::setWalkOrder(std::vector<Key> keys)
+{
+  walk_order_ = std::move(keys);
+  walk_next_ = 0;
+}
+
+
+bool ConcurrentPlaneFillLayeredWalker::walkNext(Key &key)
+{
+  if (walk_next_ < walk_order_.size())
+  {
+    key = walk_order_[walk_next_++];
+    return true;
+  }
+
+  return false;
+}
+
+
+void ConcurrentPlaneFillLayeredWalker::lookahead(const Key & /*key*/, std::vector<Key> &keys, size_t max_count) const
+{
+  const size_t count = std::min(max_count, walk_order_.size() - walk_next_);
+  keys.insert(keys.end(), walk_order_.begin() + std::ptrdiff_t(walk_next_),
+              walk_order_.begin() + std::ptrdiff_t(walk_next_ + count));
+}
+
+
+bool ConcurrentPlaneFillLayeredWalker::touch(unsigned grid_index, int visit_height, bool column_mode)
+{
+  Stripe &stripe = stripes_[grid_index % kStripeCount];
+  std::unique_lock<std::mutex> guard(stripe.mutex);
+
+  unsigned current = touched_grid_[grid_index];
+  if (column_mode && current > 0)
+  {
+    // Column already touched.
+    return false;
+  }
+
+  // Traverse the linked list of items for this grid index. current is a 1-based index in to the stripe list.
+  while (current > 0)
+  {
+    const Touched &touched = stripe.touched[current - 1];
+    if (touched.height == visit_height)
+    {
+      return false;
+    }
+    current = touched.next;
+  }
+
+  stripe.touched.emplace_back();
+  Touched &new_touch = stripe.touched.back();
+  new_touch.height = visit_height;
+  new_touch.next = touched_grid_[grid_index];
+  // Note: it is correct to use the list size to find the index of the new item as we are using a 1-based index.
+  touched_grid_[grid_index] = unsigned(stripe.touched.size());
+  return true;
+}
+
+
+unsigned ConcurrentPlaneFillLayeredWalker::gridIndexForKey(const Key &key) const
+{
+  // Get the offset for the key.
+  const auto offset_to_key = map.rangeBetween(range.minKey(), key);
+
+  if (offset_to_key[axis_indices[0]] >= 0 && offset_to_key[axis_indices[1]] >= 0 &&
+      offset_to_key[axis_indices[0]] < key_range[axis_indices[0]] &&
+      offset_to_key[axis_indices[1]] < key_range[axis_indices[1]])
+  {
+    return unsigned(offset_to_key[axis_indices[0]]) +
+           unsigned(offset_to_key[axis_indices[1]]) * unsigned(key_range[axis_indices[0]]);
+  }
+
+  // Key out of range.
+  return ~0u;
+}
+
+
+int ConcurrentPlaneFillLayeredWalker::keyHeight(const Key &key) const
+{
+  return map.rangeBetween(range.minKey(), key)[axis_indices[2]];
+}
+}  // namespace ohm
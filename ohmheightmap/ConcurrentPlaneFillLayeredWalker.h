@@ -0,0 +1,156 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMHEIGHTMAP_CONCURRENTPLANEFILLLAYEREDWALKER_H
+#define OHMHEIGHTMAP_CONCURRENTPLANEFILLLAYEREDWALKER_H
+
+#include "OhmHeightmapConfig.h"
+
+#include "PlaneWalkVisitMode.h"
+#include "UpAxis.h"
+
+#include <ohm/Key.h>
+#include <ohm/KeyRange.h>
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cinttypes>
+#include <mutex>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+
+/// A variant of the @c PlaneFillLayeredWalker which supports expanding the fill from multiple threads.
+///
+/// The @c PlaneFillLayeredWalker drives a single open list, making the fill inherently serial. This walker instead
+/// supports concurrent calls to @c touchNeighbours() , which atomically checks and marks the neighbours of a key as
+/// touched with the same semantics as @c PlaneFillLayeredWalker::visit() . This allows each thread to hold its own
+/// frontier of keys to expand. The @c Heightmap uses this with the thread pool work stealing to distribute the
+/// frontiers across threads - see @c Heightmap::setConcurrentFill() .
+///
+/// Once the concurrent fill completes, the resulting keys are set using @c setWalkOrder() . The walker then replays
+/// these keys via @c walkNext() to generate the heightmap. In this mode @c visit() does not add neighbours as the
+/// fill is already complete.
+///
+/// Touched state is tracked per 2D cell as a list of visit heights, as for the @c PlaneFillLayeredWalker . Access to
+/// each cell is guarded by one of a fixed set of mutexes, selected by the cell index.
+class ohmheightmap_API ConcurrentPlaneFillLayeredWalker
+{
+public:
+  /// Number of mutex stripes used to guard the touched state.
+  static constexpr unsigned kStripeCount = 64u;
+
+  const OccupancyMap &map;     ///< Map to walk voxels in.
+  const KeyRange range;        ///< Specifies the key extents to visit. The up axis is used to limit visiting heights.
+  const glm::ivec3 key_range;  ///< The key range covered by @c range.
+  /// Mapping of the indices to walk, supporting various heightmap up axes. Element 2 is always the up axis, where
+  /// elements 0 and 1 are the horizontal axes.
+  const std::array<int, 3> axis_indices;
+  /// Sign of the up axis [1, -1].
+  const int up_sign;
+
+  /// Constructor.
+  /// @param map The map to walk voxels in.
+  /// @param min_ext_key The minimal extents to visit.
+  /// @param max_ext_key The maximal extents to visit.
+  /// @param up_axis Defines the up axis for the plane being visited.
+  ConcurrentPlaneFillLayeredWalker(const OccupancyMap &map, const Key &min_ext_key, const Key &max_ext_key,
+                                   UpAxis up_axis);
+
+  /// Query the minimum key value to fill to.
+  /// @return The mimimum key value.
+  inline const Key &minKey() const { return range.minKey(); }
+  /// Query the maximum key value to fill to.
+  /// @return The maximum key value.
+  inline const Key &maxKey() const { return range.maxKey(); }
+
+  /// Begin walking keys starting from the given @p key . This clears the touched state and the walk order.
+  /// @param[in,out] key The seed key for walking. The key will be clamped to @c range .
+  /// @return True if the range defines a valid region to walk.
+  bool begin(Key &key);
+
+  /// Touch the unvisited neighbours of @p key , as for @c PlaneFillLayeredWalker::visit() . The neighbours are not
+  /// added to any open list; the caller is responsible for expanding the reported neighbours.
+  ///
+  /// This function is threadsafe. Each neighbour is reported to only one caller.
+  ///
+  /// @param key The key being visited. Must fall within the @c range.minKey() and @c range.maxKey() bounds.
+  /// @param mode Affects how to expand neighbours when visiting the voxel at @p key.
+  /// @param neighbours Populated with the neighbours of @p key which have been touched by this call.
+  /// @return The number of neighbours touched.
+  size_t touchNeighbours(const Key &key, PlaneWalkVisitMode mode, std::array<Key, 8> &neighbours);
+
+  /// Set the keys to walk via @c walkNext() , generally the keys expanded using @c touchNeighbours() . This excludes
+  /// the seed key given to @c begin() .
+  /// @param keys The keys to walk in order.
+  void setWalkOrder(std::vector<Key> keys);
+
+  /// Walk the next key in the walk order.
+  /// @param[in,out] key Modifies to be the next key to be walked.
+  /// @return True if the key is valid, false if walking is complete.
+  bool walkNext(Key &key);
+
+  /// Collect up to @p max_count keys which are walked after @p key , in walk order.
+  /// @param key The current walk key.
+  /// @param[out] keys Keys are appended to this container.
+  /// @param max_count Maximum number of keys to append.
+  void lookahead(const Key &key, std::vector<Key> &keys, size_t max_count) const;
+
+  /// Visit a key while replaying the walk order. This does nothing as the neighbours have already been expanded.
+  /// @return Zero - no neighbours are added.
+  inline size_t visit(const Key & /*key*/, PlaneWalkVisitMode /*mode*/, std::array<Key, 8> & /*neighbours*/)
+  {
+    return 0;
+  }
+  /// @overload
+  inline size_t visit(const Key & /*key*/, PlaneWalkVisitMode /*mode*/) { return 0; }
+
+private:
+  /// Entry used to track node visiting. See @c PlaneFillLayeredWalker::Touched .
+  struct Touched
+  {
+    /// Height at which the cell has been visited.
+    int height;
+    /// 1-based index of the next entry for the same cell in the owning @c Stripe::touched list. Zero is null.
+    unsigned next;
+  };
+
+  /// Touched state for the cells guarded by a single mutex.
+  struct Stripe
+  {
+    /// Guards access to @c touched and to the @c touched_grid_ cells of the stripe.
+    std::mutex mutex;
+    /// Touched entries for the stripe cells.
+    std::vector<Touched> touched;
+  };
+
+  /// Touch the cell at @p grid_index at @p visit_height unless already touched.
+  /// @param grid_index An index into @c touched_grid_ .
+  /// @param visit_height The height at which to visit.
+  /// @param column_mode True to only touch the cell if it has not been touched at any height.
+  /// @return True if the cell has been touched by this call.
+  bool touch(unsigned grid_index, int visit_height, bool column_mode);
+
+  /// Calculate the @c touched_grid_ index for the given @p key .
+  unsigned gridIndexForKey(const Key &key) const;
+  /// Query the visit height for @p key .
+  int keyHeight(const Key &key) const;
+
+  /// Mutex stripes and touched state.
+  std::array<Stripe, kStripeCount> stripes_;
+  /// A grid of 1-based indices into the @c Stripe::touched list of the cell's stripe, sized to match the 2D region of
+  /// @c range . Zero marks an untouched cell.
+  std::vector<unsigned> touched_grid_;
+  /// Keys to walk when replaying the fill.
+  std::vector<Key> walk_order_;
+  /// Index of the next item in @c walk_order_ .
+  size_t walk_next_ = 0;
+};
+}  // namespace ohm
+
+#endif  // OHMHEIGHTMAP_CONCURRENTPLANEFILLLAYEREDWALKER_H
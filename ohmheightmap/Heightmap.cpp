@@ -8,6 +8,7 @@
 #include "private/HeightmapDetail.h"
 #include "private/HeightmapOperations.h"
 
+#include "ConcurrentPlaneFillLayeredWalker.h"
 #include "HeightmapUtil.h"
 #include "PlaneFillLayeredWalker.h"
 #include "PlaneFillWalker.h"
@@ -21,6 +22,8 @@
 #include <ohm/MapInfo.h>
 #include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
+#include <ohm/MapRegion.h>
+#include <ohm/TaskArena.h>
 #include <ohm/Trace.h>
 
 #include <glm/vec3.hpp>
@@ -33,12 +36,31 @@
 
 #include <3esservermacros.h>
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#endif  // OHM_FEATURE_THREADS
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 // Enable code to support breaking on a specific voxel.
 #define HM_DEBUG_VOXEL 0
@@ -47,6 +69,459 @@ namespace ohm
 {
 namespace heightmap
 {
+/// Results of searching a single column for ground. See @c searchColumn() .
+struct ColumnSearch
+{
+  /// Nearest supporting voxel key from @c findNearestSupportingVoxel() . May be null.
+  Key candidate_key = Key(nullptr);
+  /// Ground resolved from @c candidate_key . Invalid if @c candidate_key is null or no ground is found.
+  GroundCandidate ground;
+};
+
+/// Number of walk keys to search ahead of the walk when using multiple threads.
+constexpr size_t kColumnSearchLookahead = 1024u;
+/// Frontier size at which @c concurrentWalk() shares half of a thread's frontier with other threads.
+constexpr size_t kFillFrontierShareSize = 64u;
+
+
+/// Search the column at @p walk_key for a ground candidate. This calls @c findNearestSupportingVoxel() followed by
+/// @c findGround() . The result depends only on @p walk_key, @p flags and the source map, so it may be evaluated
+/// concurrently for different keys, provided each thread uses its own @p voxel .
+/// @param voxel Source map voxel accessor.
+/// @param walk_key The key extracted from the plane walker.
+/// @param min_key Min extents limits.
+/// @param max_key Max extents limits.
+/// @param voxel_floor Number of voxels below @p walk_key to search.
+/// @param voxel_ceiling Number of voxels above @p walk_key to search.
+/// @param clearance_voxel_count_permissive See @c findNearestSupportingVoxel() .
+/// @param flags @c SupportingVoxelFlag values.
+/// @param imp Heightmap implementation.
+/// @return The column search results.
+ColumnSearch searchColumn(SrcVoxel &voxel, const Key &walk_key, const Key &min_key, const Key &max_key,
+                          int voxel_floor, int voxel_ceiling, int clearance_voxel_count_permissive, unsigned flags,
+                          const HeightmapDetail &imp)
+{
+  ColumnSearch result;
+  // Extract the column once for both searches below.
+  voxel.extractColumn(walk_key, min_key, max_key, imp.vertical_axis_index);
+  // Find the nearest voxel to the current key which may be a ground candidate.
+  // This is key closest to the walk_key which could be ground. This will be either an occupied voxel, or virtual
+  // ground voxel.
+  // Virtual ground is where a free is supported by an uncertain or null voxel below it.
+  result.candidate_key = findNearestSupportingVoxel(voxel, walk_key, imp.up_axis_id, min_key, max_key, voxel_floor,
+                                                    voxel_ceiling, clearance_voxel_count_permissive, flags);
+
+  // Walk the column of candidate_key to find the first occupied voxel with sufficent clearance. A virtual voxel
+  // with sufficient clearance may be given if there is no valid occupied voxel.
+  if (!result.candidate_key.isNull())
+  {
+    findGround(result.ground, voxel, result.candidate_key, min_key, max_key, imp);
+  }
+  return result;
+}
+
+
+/// Column search results shared between the heightmaps generated by @c Heightmap::buildHeightmaps() .
+///
+/// A @c searchColumn() result depends on the walk key, the search flags and the vertical extents limits. The lateral
+/// extents only affect which columns are walked. All other inputs are fixed for the batch, so these form the cache
+/// key and results may be reused by any build in the batch which walks the same column.
+struct ColumnSearchCache
+{
+  /// Cache entry key.
+  struct Entry
+  {
+    /// The column walk key.
+    Key walk_key;
+    /// Minimum vertical voxel coordinate of the extents limits.
+    int min_coord;
+    /// Maximum vertical voxel coordinate of the extents limits.
+    int max_coord;
+    /// @c SupportingVoxelFlag values.
+    unsigned flags;
+
+    inline bool operator==(const Entry &other) const
+    {
+      return walk_key == other.walk_key && min_coord == other.min_coord && max_coord == other.max_coord &&
+             flags == other.flags;
+    }
+  };
+
+  /// Hash for @c Entry .
+  struct Hash
+  {
+    inline size_t operator()(const Entry &entry) const
+    {
+      size_t hash = Key::Hash()(entry.walk_key);
+      hash = hash * 31u + size_t(entry.min_coord);
+      hash = hash * 31u + size_t(entry.max_coord);
+      return hash * 31u + entry.flags;
+    }
+  };
+
+  /// Cached column search results.
+  std::unordered_map<Entry, ColumnSearch, Hash> columns;
+
+  /// Build the cache key for a @c searchColumn() call.
+  /// @param walk_key The column walk key.
+  /// @param min_key Min extents limits.
+  /// @param max_key Max extents limits.
+  /// @param flags @c SupportingVoxelFlag values.
+  /// @param imp Heightmap implementation.
+  /// @return The cache entry key.
+  static Entry entry(const Key &walk_key, const Key &min_key, const Key &max_key, unsigned flags,
+                     const HeightmapDetail &imp)
+  {
+    const int axis = imp.vertical_axis_index;
+    const int region_dim = imp.occupancy_map->regionVoxelDimensions()[axis];
+    return Entry{ walk_key, min_key.regionKey()[axis] * region_dim + min_key.localKey()[axis],
+                  max_key.regionKey()[axis] * region_dim + max_key.localKey()[axis], flags };
+  }
+};
+
+
+/// Call @c searchColumn() , reusing results from the @c HeightmapDetail::column_cache when available.
+ColumnSearch cachedSearchColumn(SrcVoxel &voxel, const Key &walk_key, const Key &min_key, const Key &max_key,
+                                int voxel_floor, int voxel_ceiling, int clearance_voxel_count_permissive,
+                                unsigned flags, const HeightmapDetail &imp)
+{
+  if (!imp.column_cache)
+  {
+    return searchColumn(voxel, walk_key, min_key, max_key, voxel_floor, voxel_ceiling,
+                        clearance_voxel_count_permissive, flags, imp);
+  }
+
+  const ColumnSearchCache::Entry entry = ColumnSearchCache::entry(walk_key, min_key, max_key, flags, imp);
+  auto iter = imp.column_cache->columns.find(entry);
+  if (iter == imp.column_cache->columns.end())
+  {
+    const ColumnSearch column = searchColumn(voxel, walk_key, min_key, max_key, voxel_floor, voxel_ceiling,
+                                             clearance_voxel_count_permissive, flags, imp);
+    iter = imp.column_cache->columns.emplace(entry, column).first;
+  }
+  return iter->second;
+}
+
+
+#ifdef OHM_FEATURE_THREADS
+/// Invoke @p func in the task arena limiting concurrency to @c HeightmapDetail::thread_count , creating the arena on
+/// first use. The library @c ohm::taskArena() is used when the thread count is zero (automatic).
+/// @param imp Heightmap implementation.
+/// @param func The function to invoke.
+template <typename Func>
+void threadExecute(HeightmapDetail &imp, Func &&func)
+{
+  if (imp.thread_count == 0)
+  {
+    ohm::parallelExecute(func);
+    return;
+  }
+
+  if (!imp.arena)
+  {
+    imp.arena = std::make_unique<tbb::task_arena>(int(imp.thread_count));
+  }
+  imp.arena->execute(func);
+}
+
+
+/// Ensure @p cache contains @c searchColumn() results for @p walk_key , searching ahead of the @p walker in parallel
+/// on a cache miss.
+///
+/// The walker @c lookahead() keys are those which the walker will (most likely) visit next. These are searched
+/// speculatively with the results added to the @p cache . The walk itself - visiting keys and writing the
+/// heightmap - remains serial so the result is identical to the single threaded walk. Keys which the walker ends
+/// up not visiting, or visits with different search parameters, are simply never consumed from the cache.
+///
+/// @return An iterator to the @p cache entry for @p walk_key .
+template <typename Walker>
+std::unordered_map<Key, ColumnSearch>::iterator
+prefetchColumns(std::unordered_map<Key, ColumnSearch> &cache, std::vector<Key> &batch, const Walker &walker,
+                const Key &walk_key, bool use_voxel_mean, int voxel_floor, int voxel_ceiling,
+                int clearance_voxel_count_permissive, unsigned flags, HeightmapDetail &imp)
+{
+  auto iter = cache.find(walk_key);
+  if (iter != cache.end())
+  {
+    return iter;
+  }
+
+  // Cache miss. Search this key and those the walker will visit next.
+  batch.clear();
+  batch.emplace_back(walk_key);
+  walker.lookahead(walk_key, batch, kColumnSearchLookahead);
+  // Reserve cache entries, removing keys we already have results for and duplicates while preserving order.
+  size_t batch_size = 0;
+  for (const Key &key : batch)
+  {
+    if (cache.emplace(key, ColumnSearch()).second)
+    {
+      batch[batch_size++] = key;
+    }
+  }
+  batch.resize(batch_size);
+
+  if (imp.column_cache)
+  {
+    // Take results from the batch cache where available, leaving only the keys we have yet to search.
+    batch_size = 0;
+    for (const Key &key : batch)
+    {
+      const auto shared = imp.column_cache->columns.find(
+        ColumnSearchCache::entry(key, walker.minKey(), walker.maxKey(), flags, imp));
+      if (shared != imp.column_cache->columns.end())
+      {
+        cache[key] = shared->second;
+      }
+      else
+      {
+        batch[batch_size++] = key;
+      }
+    }
+    batch.resize(batch_size);
+  }
+
+  std::vector<ColumnSearch> results(batch.size());
+  const OccupancyMap &src_map = *imp.occupancy_map;
+  threadExecute(imp, [&]() {
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, batch.size()), [&](const tbb::blocked_range<size_t> &range) {
+      SrcVoxel voxel(src_map, use_voxel_mean);
+      for (size_t i = range.begin(); i != range.end(); ++i)
+      {
+        results[i] = searchColumn(voxel, batch[i], walker.minKey(), walker.maxKey(), voxel_floor, voxel_ceiling,
+                                  clearance_voxel_count_permissive, flags, imp);
+      }
+    });
+  });
+
+  for (size_t i = 0; i < batch.size(); ++i)
+  {
+    cache[batch[i]] = results[i];
+    if (imp.column_cache)
+    {
+      imp.column_cache->columns.emplace(
+        ColumnSearchCache::entry(batch[i], walker.minKey(), walker.maxKey(), flags, imp), results[i]);
+    }
+  }
+
+  return cache.find(walk_key);
+}
+
+
+/// Complete the fill for @p walker ahead of the heightmap walk using multiple threads. This does nothing for walkers
+/// other than the @c ConcurrentPlaneFillLayeredWalker .
+template <typename Walker>
+void concurrentWalk(Walker & /*walker*/, std::unordered_map<Key, ColumnSearch> & /*cache*/, const Key & /*seed_key*/,
+                    bool /*use_voxel_mean*/, int /*voxel_floor*/, int /*voxel_ceiling*/,
+                    int /*clearance_voxel_count_permissive*/, unsigned /*initial_flags*/, unsigned /*flags*/,
+                    HeightmapDetail & /*imp*/)
+{}
+
+
+/// Complete the flood fill for a @c ConcurrentPlaneFillLayeredWalker using multiple threads.
+///
+/// The @p seed_key is searched first using the @p initial_flags and its neighbours touched. Each thread then expands
+/// its own frontier of keys, searching each column and touching its neighbours as @c onVisitWalker() would. Once a
+/// frontier grows large enough, half of it is handed off as a new task, allowing idle threads to pick up the work.
+///
+/// The search results are added to the @p cache and the visited keys set as the @p walker walk order, sorted for
+/// repeatable results. The heightmap walk then consumes the @p cache entries via @c prefetchColumns() .
+void concurrentWalk(ConcurrentPlaneFillLayeredWalker &walker, std::unordered_map<Key, ColumnSearch> &cache,
+                    const Key &seed_key, bool use_voxel_mean, int voxel_floor, int voxel_ceiling,
+                    int clearance_voxel_count_permissive, unsigned initial_flags, unsigned flags,
+                    HeightmapDetail &imp)
+{
+  const OccupancyMap &src_map = *imp.occupancy_map;
+  // Touch the neighbours of the column search results for key, returning the number touched.
+  const auto touch_neighbours = [&walker](const Key &key, const ColumnSearch &column, std::array<Key, 8> &neighbours) {
+    const Key &ground_key = (column.ground.isValid()) ? column.ground.key : key;
+    const auto mode = (!column.candidate_key.isNull()) ? PlaneWalkVisitMode::kAddUnvisitedNeighbours :
+                                                         PlaneWalkVisitMode::kAddUnvisitedColumnNeighbours;
+    return walker.touchNeighbours(ground_key, mode, neighbours);
+  };
+
+  std::deque<Key> seed_frontier;
+  {
+    std::array<Key, 8> neighbours;
+    // The seed is searched again by the heightmap walk, so we do not keep the result.
+    SrcVoxel voxel(src_map, use_voxel_mean);
+    const ColumnSearch column = searchColumn(voxel, seed_key, walker.minKey(), walker.maxKey(), voxel_floor,
+                                             voxel_ceiling, clearance_voxel_count_permissive, initial_flags, imp);
+    const size_t added = touch_neighbours(seed_key, column, neighbours);
+    seed_frontier.insert(seed_frontier.end(), neighbours.begin(), neighbours.begin() + std::ptrdiff_t(added));
+  }
+
+  tbb::enumerable_thread_specific<SrcVoxel> voxels([&src_map, use_voxel_mean]() {  //
+    return SrcVoxel(src_map, use_voxel_mean);
+  });
+  tbb::enumerable_thread_specific<std::vector<std::pair<Key, ColumnSearch>>> visited;
+  tbb::task_group group;
+
+  std::function<void(std::deque<Key> &)> expand_frontier = [&](std::deque<Key> &frontier) {
+    SrcVoxel &voxel = voxels.local();
+    auto &results = visited.local();
+    std::array<Key, 8> neighbours;
+    while (!frontier.empty())
+    {
+      const Key key = frontier.front();
+      frontier.pop_front();
+      const ColumnSearch column = searchColumn(voxel, key, walker.minKey(), walker.maxKey(), voxel_floor,
+                                               voxel_ceiling, clearance_voxel_count_permissive, flags, imp);
+      const size_t added = touch_neighbours(key, column, neighbours);
+      frontier.insert(frontier.end(), neighbours.begin(), neighbours.begin() + std::ptrdiff_t(added));
+      results.emplace_back(key, column);
+
+      if (frontier.size() >= kFillFrontierShareSize)
+      {
+        // Share the back half of the frontier.
+        const auto split = frontier.begin() + std::ptrdiff_t(frontier.size() / 2);
+        auto shared = std::make_shared<std::deque<Key>>(split, frontier.end());
+        frontier.erase(split, frontier.end());
+        group.run([shared, &expand_frontier]() { expand_frontier(*shared); });
+      }
+    }
+  };
+
+  threadExecute(imp, [&]() {
+    group.run([&]() { expand_frontier(seed_frontier); });
+    group.wait();
+  });
+
+  std::vector<Key> walk_order;
+  for (const auto &results : visited)
+  {
+    for (const auto &result : results)
+    {
+      walk_order.emplace_back(result.first);
+      cache[result.first] = result.second;
+    }
+  }
+  std::sort(walk_order.begin(), walk_order.end());
+  walker.setWalkOrder(std::move(walk_order));
+}
+#endif  // OHM_FEATURE_THREADS
+
+
+/// Calculate the base @c SupportingVoxelFlag values from the heightmap generation parameters.
+/// @param imp Heightmap implementation.
+/// @return The supporting voxel flags.
+unsigned baseSupportingFlags(const HeightmapDetail &imp)
+{
+  return !!imp.generate_virtual_surface * kVirtualSurfaces | !!imp.promote_virtual_below * kPromoteVirtualBelow;
+}
+
+
+/// Calculate the source map extents from which to generate a heightmap.
+/// @param src_map The source map.
+/// @param cull_to Limits the extents along each axis where the @c Aabb::diagonal() is positive.
+/// @param[out] min_ext_key Set to the minimum extents key.
+/// @param[out] max_ext_key Set to the maximum extents key.
+void calculateSourceExtents(const OccupancyMap &src_map, const Aabb &cull_to, Key &min_ext_key, Key &max_ext_key)
+{
+  ohm::Aabb src_region;
+  src_map.calculateExtents(&src_region.minExtentsMutable(), &src_region.maxExtentsMutable());
+
+  // Clip to the cull box.
+  for (int i = 0; i < 3; ++i)
+  {
+    if (cull_to.diagonal()[i] > 0)
+    {
+      src_region.minExtentsMutable()[i] = cull_to.minExtents()[i];
+      src_region.maxExtentsMutable()[i] = cull_to.maxExtents()[i];
+    }
+  }
+
+  // Generate keys for these extents.
+  min_ext_key = src_map.voxelKey(src_region.minExtents());
+  max_ext_key = src_map.voxelKey(src_region.maxExtents());
+}
+
+
+/// Capture the @c HeightmapBuildState for building a heightmap with the current parameters.
+/// @param imp Heightmap implementation.
+/// @param reference_pos The heightmap reference position.
+/// @param cull_to The cull extents.
+/// @param min_ext_key The source map minimum extents key.
+/// @param max_ext_key The source map maximum extents key.
+/// @return The build state.
+HeightmapBuildState captureBuildState(const HeightmapDetail &imp, const glm::dvec3 &reference_pos,
+                                      const Aabb &cull_to, const Key &min_ext_key, const Key &max_ext_key)
+{
+  HeightmapBuildState state;
+  state.occupancy_map = imp.occupancy_map;
+  state.stamp = imp.occupancy_map->stamp();
+  state.reference_key = imp.occupancy_map->voxelKey(reference_pos);
+  state.min_ext_key = min_ext_key;
+  state.max_ext_key = max_ext_key;
+  state.cull_to = cull_to;
+  state.ceiling = imp.ceiling;
+  state.floor = imp.floor;
+  state.min_clearance = imp.min_clearance;
+  state.supporting_flags = baseSupportingFlags(imp);
+  state.virtual_surface_filter_threshold = imp.virtual_surface_filter_threshold;
+  state.mode = imp.mode;
+  state.ignore_voxel_mean = imp.ignore_voxel_mean;
+  state.valid = true;
+  return state;
+}
+
+
+/// Check if a heightmap built with the @p last state may be incrementally updated to the @p current state.
+/// @param last The state of the last build.
+/// @param current The state for the new build.
+/// @param vertical_axis_index The heightmap vertical axis index.
+/// @return True if an incremental update is possible, false if a full rebuild is required.
+bool canUpdateIncrementally(const HeightmapBuildState &last, const HeightmapBuildState &current,
+                            int vertical_axis_index)
+{
+  if (!last.valid || last.occupancy_map != current.occupancy_map || current.stamp < last.stamp ||
+      !(last.cull_to == current.cull_to) || last.ceiling != current.ceiling || last.floor != current.floor ||
+      last.min_clearance != current.min_clearance || last.supporting_flags != current.supporting_flags ||
+      last.virtual_surface_filter_threshold != current.virtual_surface_filter_threshold ||
+      last.mode != current.mode || last.ignore_voxel_mean != current.ignore_voxel_mean)
+  {
+    return false;
+  }
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (axis == vertical_axis_index)
+    {
+      // The vertical extents bound the search in every column.
+      if (!last.min_ext_key.isBounded(axis, current.min_ext_key, current.min_ext_key) ||
+          !last.max_ext_key.isBounded(axis, current.max_ext_key, current.max_ext_key))
+      {
+        return false;
+      }
+    }
+    // Horizontal extents may only grow. Shrinking implies regions have been removed.
+    else if (!last.min_ext_key.isBounded(axis, current.min_ext_key, current.max_ext_key) ||
+             !last.max_ext_key.isBounded(axis, current.min_ext_key, current.max_ext_key))
+    {
+      return false;
+    }
+  }
+
+  if (current.mode == HeightmapMode::kPlanar)
+  {
+    // Only the plane height matters.
+    return last.reference_key.isBounded(vertical_axis_index, current.reference_key, current.reference_key);
+  }
+
+  return last.reference_key == current.reference_key;
+}
+
+
+/// Calculate the index of the heightmap tile containing a heightmap region along a single axis.
+/// @param region_coord The region key coordinate.
+/// @param regions_per_tile The number of regions in each tile along the axis.
+/// @return The tile index, rounding towards negative infinity.
+int tileIndex(int region_coord, int regions_per_tile)
+{
+  return (region_coord >= 0) ? region_coord / regions_per_tile : -((-region_coord - 1) / regions_per_tile) - 1;
+}
+
+
 /// Helper function for visiting a heightmap node. This expands into the neighbours as required and performs debug
 /// rendering.
 /// @param walker The class used to walk the heightmap region. Examples; @c PlaneWalker , @c PlanerFillWalker ,
@@ -152,6 +627,41 @@ Heightmap::Heightmap(double grid_resolution, double min_clearance, UpAxis up_axi
 Heightmap::~Heightmap() = default;
 
 
+bool Heightmap::setThreadCount(unsigned thread_count)
+{
+#ifdef OHM_FEATURE_THREADS
+  if (thread_count != imp_->thread_count)
+  {
+    imp_->thread_count = thread_count;
+    imp_->arena.reset();
+  }
+  return true;
+#else   // OHM_FEATURE_THREADS
+  (void)thread_count;
+  imp_->thread_count = 1;
+  return false;
+#endif  // OHM_FEATURE_THREADS
+}
+
+
+unsigned Heightmap::threadCount() const
+{
+  return imp_->thread_count;
+}
+
+
+void Heightmap::setConcurrentFill(bool enable)
+{
+  imp_->concurrent_fill = enable;
+}
+
+
+bool Heightmap::concurrentFill() const
+{
+  return imp_->concurrent_fill;
+}
+
+
 void Heightmap::setOccupancyMap(const OccupancyMap *map)
 {
   imp_->occupancy_map = map;
@@ -347,26 +857,14 @@ bool Heightmap::buildHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb
   // 2. Populate heightmap voxels
 
   const OccupancyMap &src_map = *imp_->occupancy_map;
-  ohm::Aabb src_region;
-  src_map.calculateExtents(&src_region.minExtentsMutable(), &src_region.maxExtentsMutable());
-
-  // Clip to the cull box.
-  for (int i = 0; i < 3; ++i)
-  {
-    if (cull_to.diagonal()[i] > 0)
-    {
-      src_region.minExtentsMutable()[i] = cull_to.minExtents()[i];
-      src_region.maxExtentsMutable()[i] = cull_to.maxExtents()[i];
-    }
-  }
-
-  // Generate keys for these extents.
-  const Key min_ext_key = src_map.voxelKey(src_region.minExtents());
-  const Key max_ext_key = src_map.voxelKey(src_region.maxExtents());
+  Key min_ext_key(nullptr);
+  Key max_ext_key(nullptr);
+  heightmap::calculateSourceExtents(src_map, cull_to, min_ext_key, max_ext_key);
+  const HeightmapBuildState build_state =
+    heightmap::captureBuildState(*imp_, reference_pos, cull_to, min_ext_key, max_ext_key);
 
   unsigned processed_count = 0;
-  unsigned supporting_voxel_flags = !!imp_->generate_virtual_surface * heightmap::kVirtualSurfaces |
-                                    !!imp_->promote_virtual_below * heightmap::kPromoteVirtualBelow;
+  unsigned supporting_voxel_flags = heightmap::baseSupportingFlags(*imp_);
   switch (imp_->mode)
   {
   case HeightmapMode::kPlanar:  //
@@ -396,6 +894,14 @@ bool Heightmap::buildHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb
     // supporting voxel to the seed voxel.
     const unsigned initial_supporting_voxel_flags = supporting_voxel_flags;
     supporting_voxel_flags |= heightmap::kBiasAbove;
+#ifdef OHM_FEATURE_THREADS
+    if (imp_->concurrent_fill && imp_->thread_count != 1)
+    {
+      ConcurrentPlaneFillLayeredWalker walker(src_map, min_ext_key, max_ext_key, imp_->up_axis_id);
+      processed_count = buildHeightmapT(walker, reference_pos, initial_supporting_voxel_flags, supporting_voxel_flags);
+      break;
+    }
+#endif  // OHM_FEATURE_THREADS
     PlaneFillLayeredWalker walker(src_map, min_ext_key, max_ext_key, imp_->up_axis_id);
     processed_count = buildHeightmapT(walker, reference_pos, initial_supporting_voxel_flags, supporting_voxel_flags);
     break;
@@ -404,6 +910,8 @@ bool Heightmap::buildHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb
     break;
   }
 
+  imp_->last_build = build_state;
+
 #if PROFILING
   ohm::Profile::instance().report();
 #endif  // PROFILING
@@ -412,6 +920,303 @@ bool Heightmap::buildHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb
 }
 
 
+bool Heightmap::updateHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb &cull_to)
+{
+  if (!imp_->occupancy_map)
+  {
+    return false;
+  }
+
+  const OccupancyMap &src_map = *imp_->occupancy_map;
+  Key min_ext_key(nullptr);
+  Key max_ext_key(nullptr);
+  heightmap::calculateSourceExtents(src_map, cull_to, min_ext_key, max_ext_key);
+  const HeightmapBuildState build_state =
+    heightmap::captureBuildState(*imp_, reference_pos, cull_to, min_ext_key, max_ext_key);
+
+  if (!heightmap::canUpdateIncrementally(imp_->last_build, build_state, imp_->vertical_axis_index))
+  {
+    return buildHeightmap(reference_pos, cull_to);
+  }
+
+  PROFILE(updateHeightmap);
+
+  // Collect the dirty regions which overlap the source extents.
+  std::vector<std::pair<uint64_t, glm::i16vec3>> dirty_regions;
+  src_map.collectDirtyRegions(imp_->last_build.stamp, dirty_regions);
+  const glm::ivec3 min_region = min_ext_key.regionKey();
+  const glm::ivec3 max_region = max_ext_key.regionKey();
+  dirty_regions.erase(std::remove_if(dirty_regions.begin(), dirty_regions.end(),
+                                     [&min_region, &max_region](const std::pair<uint64_t, glm::i16vec3> &dirty) {
+                                       const glm::ivec3 region_key = dirty.second;
+                                       return glm::any(glm::lessThan(region_key, min_region)) ||
+                                              glm::any(glm::greaterThan(region_key, max_region));
+                                     }),
+                      dirty_regions.end());
+
+  if (!dirty_regions.empty())
+  {
+    if (imp_->mode != HeightmapMode::kPlanar)
+    {
+      // Fill results depend on the walk from the seed. Rebuild.
+      return buildHeightmap(reference_pos, cull_to);
+    }
+
+    updatePlanar(reference_pos, min_ext_key, max_ext_key, dirty_regions,
+                 heightmap::baseSupportingFlags(*imp_) | heightmap::kIgnoreVirtualAbove);
+  }
+
+  imp_->last_build = build_state;
+  return true;
+}
+
+
+bool Heightmap::buildHeightmapTiles(const glm::dvec3 &reference_pos, const ohm::Aabb &cull_to, double tile_size,
+                                    double overlap, const HeightmapTileFunction &on_tile)
+{
+  if (!imp_->occupancy_map || !on_tile)
+  {
+    return false;
+  }
+
+  PROFILE(buildHeightmapTiles);
+
+  const OccupancyMap &src_map = *imp_->occupancy_map;
+  const OccupancyMap &hm_map = *imp_->heightmap;
+  const std::array<int, 2> surface_axes = { surfaceAxisIndexA(), surfaceAxisIndexB() };
+  const int vertical_axis = imp_->vertical_axis_index;
+
+  Key min_ext_key(nullptr);
+  Key max_ext_key(nullptr);
+  heightmap::calculateSourceExtents(src_map, cull_to, min_ext_key, max_ext_key);
+  // Use the extents voxel centres to limit the tile extents. These resolve to the same extents keys.
+  const glm::dvec3 src_min = src_map.voxelCentreGlobal(min_ext_key);
+  const glm::dvec3 src_max = src_map.voxelCentreGlobal(max_ext_key);
+
+  // Resolve the tile index range. Each tile covers a whole number of heightmap regions.
+  const glm::dvec3 region_extents = hm_map.regionSpatialResolution();
+  const glm::ivec3 min_region = hm_map.regionKey(src_min);
+  const glm::ivec3 max_region = hm_map.regionKey(src_max);
+  glm::ivec2 regions_per_tile(1);
+  glm::ivec2 min_tile(0);
+  glm::ivec2 max_tile(0);
+  for (int i = 0; i < 2; ++i)
+  {
+    const int axis = surface_axes[i];
+    regions_per_tile[i] = std::max(1, int(std::ceil(tile_size / region_extents[axis])));
+    min_tile[i] = heightmap::tileIndex(min_region[axis], regions_per_tile[i]);
+    max_tile[i] = heightmap::tileIndex(max_region[axis], regions_per_tile[i]);
+  }
+
+  std::vector<glm::ivec2> tiles;
+  tiles.reserve(size_t(max_tile.x - min_tile.x + 1) * size_t(max_tile.y - min_tile.y + 1));
+  for (int tile_b = min_tile.y; tile_b <= max_tile.y; ++tile_b)
+  {
+    for (int tile_a = min_tile.x; tile_a <= max_tile.x; ++tile_a)
+    {
+      tiles.emplace_back(tile_a, tile_b);
+    }
+  }
+
+  std::mutex on_tile_mutex;
+  std::atomic_bool aborted(false);
+  const auto build_tile = [&](const glm::ivec2 &tile_index, unsigned thread_count) {
+    HeightmapTile tile;
+    tile.index = tile_index;
+    glm::i16vec3 first_region(0);
+    glm::i16vec3 last_region(0);
+    for (int i = 0; i < 2; ++i)
+    {
+      first_region[surface_axes[i]] = int16_t(tile_index[i] * regions_per_tile[i]);
+      last_region[surface_axes[i]] = int16_t(first_region[surface_axes[i]] + regions_per_tile[i] - 1);
+    }
+    glm::dvec3 core_min = hm_map.regionSpatialMin(first_region);
+    glm::dvec3 core_max = hm_map.regionSpatialMax(last_region);
+    core_min[vertical_axis] = src_min[vertical_axis];
+    core_max[vertical_axis] = src_max[vertical_axis];
+    tile.extents = Aabb(core_min, core_max);
+
+    // Generate from the core extents expanded by the overlap, limited to the source extents.
+    Aabb tile_cull(src_min, src_max);
+    for (const int axis : surface_axes)
+    {
+      tile_cull.minExtentsMutable()[axis] = std::max(src_min[axis], core_min[axis] - overlap);
+      tile_cull.maxExtentsMutable()[axis] = std::min(src_max[axis], core_max[axis] + overlap);
+    }
+
+    Heightmap tile_heightmap(hm_map.resolution(), imp_->min_clearance, imp_->up_axis_id,
+                             hm_map.regionVoxelDimensions()[surface_axes[0]]);
+    tile_heightmap.heightmap().setOrigin(hm_map.origin());
+    HeightmapDetail &tile_imp = *tile_heightmap.imp_;
+    tile_imp.occupancy_map = imp_->occupancy_map;
+    tile_imp.ceiling = imp_->ceiling;
+    tile_imp.floor = imp_->floor;
+    tile_imp.virtual_surface_filter_threshold = imp_->virtual_surface_filter_threshold;
+    tile_imp.debug_level = imp_->debug_level;
+    tile_imp.mode = imp_->mode;
+    tile_imp.ignore_voxel_mean = imp_->ignore_voxel_mean;
+    tile_imp.generate_virtual_surface = imp_->generate_virtual_surface;
+    tile_imp.promote_virtual_below = imp_->promote_virtual_below;
+    tile_imp.concurrent_fill = imp_->concurrent_fill;
+    tile_heightmap.setThreadCount(thread_count);
+
+    // Seed from the closest point to the reference position, keeping the reference height.
+    glm::dvec3 tile_seed = reference_pos;
+    for (const int axis : surface_axes)
+    {
+      tile_seed[axis] =
+        std::max(tile_cull.minExtents()[axis], std::min(reference_pos[axis], tile_cull.maxExtents()[axis]));
+    }
+
+    if (!tile_heightmap.buildHeightmap(tile_seed, tile_cull))
+    {
+      // Nothing generated.
+      return;
+    }
+
+    // Remove the overlap regions. Shrink the core by half a voxel so we don't retain regions which only touch the
+    // core.
+    glm::dvec3 crop_min = core_min;
+    glm::dvec3 crop_max = core_max;
+    for (const int axis : surface_axes)
+    {
+      crop_min[axis] += 0.5 * hm_map.resolution();
+      crop_max[axis] -= 0.5 * hm_map.resolution();
+    }
+    crop_min[vertical_axis] = std::numeric_limits<double>::lowest();
+    crop_max[vertical_axis] = std::numeric_limits<double>::max();
+    tile_heightmap.heightmap().cullRegionsOutside(crop_min, crop_max);
+
+    if (tile_heightmap.heightmap().regionCount() == 0)
+    {
+      return;
+    }
+
+    std::unique_lock<std::mutex> guard(on_tile_mutex);
+    if (!aborted && !on_tile(tile, tile_heightmap))
+    {
+      aborted = true;
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (imp_->thread_count != 1 && tiles.size() > 1)
+  {
+    heightmap::threadExecute(*imp_, [&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, tiles.size(), 1), [&](const tbb::blocked_range<size_t> &range) {
+        for (size_t i = range.begin(); i != range.end() && !aborted; ++i)
+        {
+          build_tile(tiles[i], 1u);
+        }
+      });
+    });
+
+    return !aborted;
+  }
+#endif  // OHM_FEATURE_THREADS
+
+  for (size_t i = 0; i < tiles.size() && !aborted; ++i)
+  {
+    build_tile(tiles[i], imp_->thread_count);
+  }
+
+  return !aborted;
+}
+
+
+bool Heightmap::buildHeightmaps(const std::vector<glm::dvec3> &reference_positions,
+                                const std::vector<ohm::Aabb> &cull_to, const HeightmapBatchFunction &on_heightmap)
+{
+  if (!imp_->occupancy_map || (cull_to.size() > 1 && cull_to.size() != reference_positions.size()))
+  {
+    return false;
+  }
+
+  PROFILE(buildHeightmaps);
+
+  heightmap::ColumnSearchCache column_cache;
+  imp_->column_cache = &column_cache;
+
+  bool ok = true;
+  for (size_t i = 0; i < reference_positions.size() && ok; ++i)
+  {
+    const Aabb cull = (cull_to.empty()) ? Aabb(0.0) : cull_to[std::min(i, cull_to.size() - 1)];
+    buildHeightmap(reference_positions[i], cull);
+    ok = !on_heightmap || on_heightmap(i, *this);
+  }
+
+  imp_->column_cache = nullptr;
+  return ok;
+}
+
+
+void Heightmap::updatePlanar(const glm::dvec3 &reference_pos, const Key &min_ext_key, const Key &max_ext_key,
+                             const std::vector<std::pair<uint64_t, glm::i16vec3>> &dirty_regions,
+                             unsigned supporting_voxel_flags)
+{
+  const OccupancyMap &src_map = *imp_->occupancy_map;
+  OccupancyMap &heightmap = *imp_->heightmap;
+  const std::array<int, 2> surface_axes = { surfaceAxisIndexA(), surfaceAxisIndexB() };
+  const Key planar_key = src_map.voxelKey(reference_pos);
+  // Margin used to keep world extents off voxel boundaries.
+  const double epsilon = 1e-3 * std::min(src_map.resolution(), heightmap.resolution());
+
+  // Collect the unique columns of dirty regions. Regions stacked vertically update the same heightmap voxels.
+  std::unordered_set<glm::i16vec3, MapRegion::Hash> dirty_columns;
+  for (const auto &dirty : dirty_regions)
+  {
+    glm::i16vec3 column_key = dirty.second;
+    column_key[upAxisIndex()] = 0;
+    dirty_columns.insert(column_key);
+  }
+
+  const bool use_voxel_mean = src_map.voxelMeanEnabled() && !imp_->ignore_voxel_mean;
+  heightmap::DstVoxel hm_voxel(heightmap, imp_->heightmap_voxel_layer, use_voxel_mean);
+  for (const auto &column_key : dirty_columns)
+  {
+    // Find the heightmap voxels overlapping the source region footprint.
+    Key hm_min = heightmap.voxelKey(src_map.regionSpatialMin(column_key) + glm::dvec3(epsilon));
+    Key hm_max = heightmap.voxelKey(src_map.regionSpatialMax(column_key) - glm::dvec3(epsilon));
+    project(&hm_min);
+    project(&hm_max);
+
+    // Find the source columns which contribute to those heightmap voxels, limited to the source extents. The
+    // vertical range matches the full build.
+    const double hm_half_voxel = 0.5 * heightmap.resolution();
+    const Key cover_min = src_map.voxelKey(heightmap.voxelCentreGlobal(hm_min) - glm::dvec3(hm_half_voxel - epsilon));
+    const Key cover_max = src_map.voxelKey(heightmap.voxelCentreGlobal(hm_max) + glm::dvec3(hm_half_voxel - epsilon));
+    Key src_min = min_ext_key;
+    Key src_max = max_ext_key;
+    for (int axis : surface_axes)
+    {
+      src_min.setAxisFrom(axis, cover_min);
+      src_max.setAxisFrom(axis, cover_max);
+      src_min.clampToAxis(axis, min_ext_key, max_ext_key);
+      src_max.clampToAxis(axis, min_ext_key, max_ext_key);
+    }
+
+    // Reset existing heightmap voxels to be regenerated. We must not create regions here.
+    const KeyRange update_range(hm_min, hm_max, heightmap.regionVoxelDimensions());
+    for (const Key &hm_key : update_range)
+    {
+      if (static_cast<const OccupancyMap &>(heightmap).region(hm_key.regionKey()))
+      {
+        hm_voxel.setKey(hm_key);
+        hm_voxel.occupancy.write(unobservedOccupancyValue());
+        hm_voxel.heightmap.write(HeightmapVoxel{});
+        if (hm_voxel.mean.isValid())
+        {
+          hm_voxel.mean.write(VoxelMean{});
+        }
+      }
+    }
+
+    PlaneWalker walker(src_map, src_min, src_max, imp_->up_axis_id, &planar_key);
+    buildHeightmapT(walker, reference_pos, supporting_voxel_flags, supporting_voxel_flags, &update_range);
+  }
+}
+
+
 HeightmapVoxelType Heightmap::getHeightmapVoxelInfo(const Key &key, glm::dvec3 *pos, HeightmapVoxel *voxel_info) const
 {
   if (!key.isNull())
@@ -521,7 +1326,7 @@ KeyRange Heightmap::buildReferencePlaneSlice(Key min_key, Key max_key, const glm
 
 template <typename KeyWalker>
 bool Heightmap::buildHeightmapT(KeyWalker &walker, const glm::dvec3 &reference_pos, unsigned initial_supporting_flags,
-                                unsigned iterating_supporting_flags)
+                                unsigned iterating_supporting_flags, const KeyRange *update_range)
 {
   // Brute force initial approach.
   const OccupancyMap &src_map = *imp_->occupancy_map;
@@ -530,8 +1335,11 @@ bool Heightmap::buildHeightmapT(KeyWalker &walker, const glm::dvec3 &reference_p
 
   updateMapInfo(heightmap.mapInfo());
 
-  // Clear previous results.
-  heightmap.clear();
+  // Clear previous results unless making an incremental update.
+  if (!update_range)
+  {
+    heightmap.clear();
+  }
 
   // Encode the base height of the heightmap in the origin.
   // heightmap.setOrigin(upAxisNormal() * glm::dot(upAxisNormal(), reference_pos));
@@ -584,6 +1392,18 @@ bool Heightmap::buildHeightmapT(KeyWalker &walker, const glm::dvec3 &reference_p
   // key and voxel type.
   std::unordered_map<ohm::Key, heightmap::HeightmapKeyType> src_to_heightmap_keys;
   const bool ordered_layers = areLayersSorted();  // True to sort multi-layered configurations.
+#ifdef OHM_FEATURE_THREADS
+  // Column search results calculated ahead of the walk when using multiple threads.
+  std::unordered_map<ohm::Key, heightmap::ColumnSearch> column_cache;
+  std::vector<ohm::Key> column_batch;
+  if (imp_->thread_count != 1)
+  {
+    // Complete a concurrent fill ahead of the walk. This is a no-op for most walkers.
+    heightmap::concurrentWalk(walker, column_cache, walk_key, use_voxel_mean, voxel_floor, voxel_ceiling,
+                              clearance_voxel_count_permissive, initial_supporting_flags, iterating_supporting_flags,
+                              *imp_);
+  }
+#endif  // OHM_FEATURE_THREADS
   bool abort = false;
   do
   {
@@ -601,21 +1421,26 @@ bool Heightmap::buildHeightmapT(KeyWalker &walker, const glm::dvec3 &reference_p
     }
 #endif  // HM_DEBUG_VOXEL
 
-    // Find the nearest voxel to the current key which may be a ground candidate.
-    // This is key closest to the walk_key which could be ground. This will be either an occupied voxel, or virtual
-    // ground voxel.
-    // Virtual ground is where a free is supported by an uncertain or null voxel below it.
-    Key candidate_key = heightmap::findNearestSupportingVoxel(src_voxel, walk_key, upAxis(), walker.minKey(),
-                                                              walker.maxKey(), voxel_floor, voxel_ceiling,
-                                                              clearance_voxel_count_permissive, supporting_voxel_flags);
-
-    // Walk the column of candidate_key to find the first occupied voxel with sufficent clearance. A virtual voxel
-    // with sufficient clearance may be given if there is no valid occupied voxel.
-    heightmap::GroundCandidate ground;
-    if (!candidate_key.isNull())
+    heightmap::ColumnSearch column;
+#ifdef OHM_FEATURE_THREADS
+    // Search ahead in parallel. We only do so once iterating as the initial key uses different search flags.
+    if (imp_->thread_count != 1 && supporting_voxel_flags == iterating_supporting_flags)
     {
-      findGround(ground, src_voxel, candidate_key, walker.minKey(), walker.maxKey(), *imp_);
+      auto cached = heightmap::prefetchColumns(column_cache, column_batch, walker, walk_key, use_voxel_mean,
+                                               voxel_floor, voxel_ceiling, clearance_voxel_count_permissive,
+                                               supporting_voxel_flags, *imp_);
+      column = cached->second;
+      column_cache.erase(cached);
     }
+    else
+#endif  // OHM_FEATURE_THREADS
+    {
+      column = heightmap::cachedSearchColumn(src_voxel, walk_key, walker.minKey(), walker.maxKey(), voxel_floor,
+                                             voxel_ceiling, clearance_voxel_count_permissive, supporting_voxel_flags,
+                                             *imp_);
+    }
+    const Key &candidate_key = column.candidate_key;
+    const heightmap::GroundCandidate &ground = column.ground;
     const Key ground_key = (ground.isValid()) ? ground.key : walk_key;
 
     // Mark whether this voxel may be a base layer candidate. This is always true for non-layered heightmaps.
@@ -645,8 +1470,21 @@ bool Heightmap::buildHeightmapT(KeyWalker &walker, const glm::dvec3 &reference_p
       // We only use voxel mean positioning for occupied voxels. The information is unreliable for free voxels.
       glm::dvec3 voxel_pos = (voxel_type == kOccupied) ? src_voxel.position() : src_voxel_centre;
 
-      HeightmapVoxelType hm_voxel_type =
-        addSurfaceVoxel(hm_voxel, src_voxel, voxel_type, ground, voxel_pos, multi_layer_keys, is_base_layer_candidate);
+      // Only write within the update_range for an incremental update.
+      bool in_update_range = true;
+      if (update_range)
+      {
+        glm::dvec3 hm_pos = voxel_pos;
+        hm_pos[upAxisIndex()] = 0;
+        Key hm_key = heightmap.voxelKey(hm_pos);
+        project(&hm_key);
+        in_update_range = hm_key.isBounded(update_range->minKey(), update_range->maxKey());
+      }
+
+      const HeightmapVoxelType hm_voxel_type =
+        (in_update_range) ? addSurfaceVoxel(hm_voxel, src_voxel, voxel_type, ground, voxel_pos, multi_layer_keys,
+                                            is_base_layer_candidate) :
+                            HeightmapVoxelType::kUnknown;
       if (hm_voxel_type != HeightmapVoxelType::kUnknown)
       {
         if (populated_count > 0)
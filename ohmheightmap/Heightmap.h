@@ -19,13 +19,17 @@
 #include <memory>
 
 #include <glm/fwd.hpp>
+#include <glm/vec2.hpp>
 
+#include <cstdint>
 #include <functional>
 #include <set>
+#include <utility>
 #include <vector>
 
 namespace ohm
 {
+class Heightmap;
 class Key;
 class MapInfo;
 class OccupancyMap;
@@ -40,6 +44,27 @@ struct GroundCandidate;
 struct SrcVoxel;
 }  // namespace heightmap
 
+/// Identifies a heightmap tile generated by @c Heightmap::buildHeightmapTiles() .
+struct HeightmapTile
+{
+  /// Tile index along the heightmap surface axes, @c Heightmap::surfaceAxisIndexA() and
+  /// @c Heightmap::surfaceAxisIndexB() respectively.
+  glm::ivec2 index;
+  /// Spatial extents of the tile core. This is the section of the heightmap owned by the tile and excludes the
+  /// overlap. The vertical extents match the source map extents used for generation.
+  Aabb extents = Aabb(0.0);
+};
+
+/// Callback function invoked for each tile generated by @c Heightmap::buildHeightmapTiles() . The function is given
+/// the tile details and the tile heightmap. The tile heightmap is released on return. Return false to abort tile
+/// generation.
+using HeightmapTileFunction = std::function<bool(const HeightmapTile &, Heightmap &)>;
+
+/// Callback function invoked for each heightmap generated by @c Heightmap::buildHeightmaps() . The function is given
+/// the index of the reference position and the @c Heightmap holding the result, which is overwritten by the next
+/// build. Return false to abort the batch.
+using HeightmapBatchFunction = std::function<bool(size_t, Heightmap &)>;
+
 /// A 2D voxel map variant which calculates a heightmap surface from another @c OccupancyMap .
 ///
 /// The heightmap is built from an @c OccupancyMap and forms an axis aligned collapse of that map. The up axis may be
@@ -135,8 +160,8 @@ public:
 
   /// Set number of threads to use in heightmap generation, enabling multi-threaded code path as required.
   ///
-  /// Setting the @p thread_count to zero enables multi-threading using the maximum number of threads. Setting the
-  /// @p thread_count to 1 disables threads (default).
+  /// Setting the @p thread_count to zero enables multi-threading using the maximum number of threads, or the library
+  /// @c ohm::taskArena() when installed. Setting the @p thread_count to 1 disables threads (default).
   ///
   /// Using multiple threads may not yield significant gains.
   ///
@@ -153,6 +178,23 @@ public:
   /// @return The number of threads to use.
   unsigned threadCount() const;
 
+  /// Enable concurrent flood fill for the @c HeightmapMode::kLayeredFill and @c HeightmapMode::kLayeredFillUnordered
+  /// modes when using multiple threads - see @c setThreadCount() .
+  ///
+  /// The default fill expands a single frontier, with multiple threads only used to search columns ahead of the walk.
+  /// A concurrent fill instead expands the frontier across all threads using a @c ConcurrentPlaneFillLayeredWalker ,
+  /// scaling better with the number of threads. However, the set of visited keys depends on the order in which the
+  /// frontier is expanded, so the results may differ slightly from the single threaded fill and between runs.
+  ///
+  /// Has no effect without multi-threading support or when the @c threadCount() is 1.
+  ///
+  /// @param enable True to enable concurrent fill.
+  void setConcurrentFill(bool enable);
+
+  /// Query whether concurrent flood fill is enabled. See @c setConcurrentFill() .
+  /// @return True if concurrent fill is enabled.
+  bool concurrentFill() const;
+
   /// Set the occupancy map on which to base the heightmap. The heightmap does not take ownership of the pointer so
   /// the @p map must persist until @c buildHeightmap() is called.
   void setOccupancyMap(const OccupancyMap *map);
@@ -341,6 +383,76 @@ public:
   /// @return true on success.
   bool buildHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb &cull_to = ohm::Aabb(0.0));
 
+  /// Update the heightmap from the previous @c buildHeightmap() or @c updateHeightmap() call, only regenerating
+  /// content affected by source map changes since that call.
+  ///
+  /// Changes are identified from @c OccupancyMap::collectDirtyRegions() using the source map @c OccupancyMap::stamp()
+  /// recorded on the last build. The heightmap content persists across calls and is rebuilt as follows:
+  /// - Nothing is regenerated when there are no dirty regions.
+  /// - @c HeightmapMode::kPlanar regenerates only the heightmap columns overlapping dirty source regions. The columns
+  ///   are independent, so the result matches a @c buildHeightmap() call.
+  /// - The fill modes fully regenerate when any dirty region lies within the source extents. A fill result depends on
+  ///   the walk order out from the seed, so any change may affect every column reached after it.
+  ///
+  /// A full rebuild is also made when there is no previous build, or when the source map, generation parameters,
+  /// @p cull_to extents, vertical source map extents or the seed differ from the previous build. For
+  /// @c HeightmapMode::kPlanar only the seed height is considered.
+  ///
+  /// @param reference_pos The staring position to build a heightmap around. Nominally a vehicle or sensor position.
+  /// @param cull_to Build the heightmap only from within these extents in the source map.
+  /// @return true on success.
+  bool updateHeightmap(const glm::dvec3 &reference_pos, const ohm::Aabb &cull_to = ohm::Aabb(0.0));
+
+  /// Generate the heightmap as a set of fixed size tiles, passing each tile to @p on_tile as it completes.
+  ///
+  /// This supports generating heightmaps for areas which are too large to hold in memory as a single heightmap. The
+  /// heightmap is not populated by this call. Instead, the source extents are divided into tiles along the surface
+  /// axes and each tile is generated in its own @c Heightmap using the current generation parameters. Each tile is
+  /// generated from its core extents expanded by @p overlap , allowing fill modes to walk around obstacles near the
+  /// tile boundaries. The overlap is removed before calling @p on_tile , leaving only the tile core regions. The tile
+  /// heightmaps share this object's @c heightmap() origin and region size, so the tiles align and do not overlap.
+  ///
+  /// The tile size is rounded up to a whole number of @c heightmap() regions. Tiles are generated in parallel using
+  /// up to @c threadCount() threads, with each tile generated single threaded. At most one tile per thread is held
+  /// in memory at any time. Calls to @p on_tile are serialised, but may be made from any thread and the tile order
+  /// is not defined. Tiles with no content are not reported.
+  ///
+  /// @c HeightmapMode::kPlanar tiles exactly match the corresponding section of a @c buildHeightmap() result. For
+  /// the fill modes, each tile is seeded from the closest point in the tile generation extents to @p reference_pos ,
+  /// keeping the vertical component of @p reference_pos . Fill results depend on the walk from the seed, so these
+  /// tiles may differ from a @c buildHeightmap() result, particularly away from @p reference_pos .
+  ///
+  /// @param reference_pos The staring position to build a heightmap around. Nominally a vehicle or sensor position.
+  /// @param cull_to Build the heightmap only from within these extents in the source map.
+  /// @param tile_size The spatial size of the tile cores along each surface axis.
+  /// @param overlap Distance by which to expand each tile along the surface axes for generation.
+  /// @param on_tile Function invoked for each completed tile.
+  /// @return true on success, false if there is no source map or @p on_tile returns false.
+  bool buildHeightmapTiles(const glm::dvec3 &reference_pos, const ohm::Aabb &cull_to, double tile_size,
+                           double overlap, const HeightmapTileFunction &on_tile);
+
+  /// Generate heightmaps for a set of reference positions, such as the poses along a candidate route, passing each
+  /// heightmap to @p on_heightmap as it completes.
+  ///
+  /// Each heightmap is generated in turn, exactly as @c buildHeightmap() would, into this object's @c heightmap() .
+  /// The source column searches - finding the nearest supporting voxel and ground candidate in each column - are
+  /// shared across the batch, so columns walked by several heightmaps are searched only once. The results depend
+  /// only on the column, the vertical search extents and the search flags, so the heightmaps are unaffected. Only
+  /// the walk itself and the reference dependent surface selection are repeated for each position. The shared
+  /// searches do not apply to the concurrent layered fill - see @c setConcurrentFill() .
+  ///
+  /// The source map must not be modified until the call returns. The @c heightmap() holds the last generated
+  /// heightmap on return.
+  ///
+  /// @param reference_positions The starting position for each heightmap.
+  /// @param cull_to Source map extents for each heightmap. May be empty for no culling, hold a single item used for
+  ///   all positions, or hold one item per position.
+  /// @param on_heightmap Function invoked for each completed heightmap. May be empty.
+  /// @return true on success, false if there is no source map, the @p cull_to count is invalid or @p on_heightmap
+  ///   returns false.
+  bool buildHeightmaps(const std::vector<glm::dvec3> &reference_positions, const std::vector<ohm::Aabb> &cull_to,
+                       const HeightmapBatchFunction &on_heightmap = HeightmapBatchFunction());
+
   /// Query the information about a voxel in the @c heightmap() occupancy map.
   ///
   /// Heightmap voxel values, positions and semantics are specialised from the general @c OccupancyMap usage. This
@@ -415,9 +527,21 @@ private:
   /// @param on_visit Optional callback invoked for each key visited. Parameters are: @p walker , this object's
   ///   internal details, the candidate key first evaluated for the column search start, the ground key to be migrated
   ///   to the heightmap. Both keys reference the source map.
+  /// @param update_range Optional heightmap key range for an incremental update. When given, the heightmap is not
+  ///   cleared and only heightmap voxels within this range are written. Not supported for layered heightmaps.
   template <typename KeyWalker>
   bool buildHeightmapT(KeyWalker &walker, const glm::dvec3 &reference_pos, unsigned initial_supporting_flags,
-                       unsigned iterating_supporting_flags);
+                       unsigned iterating_supporting_flags, const KeyRange *update_range = nullptr);
+
+  /// Incrementally update the @c HeightmapMode::kPlanar heightmap for the given @p dirty_regions .
+  /// @param reference_pos The reference position from which to set the plane height.
+  /// @param min_ext_key The source map minimum extents key.
+  /// @param max_ext_key The source map maximum extents key.
+  /// @param dirty_regions The source map regions which have changed.
+  /// @param supporting_voxel_flags Flags for @c heightmap::findNearestSupportingVoxel() .
+  void updatePlanar(const glm::dvec3 &reference_pos, const Key &min_ext_key, const Key &max_ext_key,
+                    const std::vector<std::pair<uint64_t, glm::i16vec3>> &dirty_regions,
+                    unsigned supporting_voxel_flags);
 
   /// Helper function for adding a surface, or virtual surface voxel from @c buildHeightmapT() .
   ///
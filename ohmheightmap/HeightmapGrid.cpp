@@ -0,0 +1,229 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "HeightmapGrid.h"
+
+#include "Heightmap.h"
+#include "HeightmapVoxel.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+
+#include <ohmutil/Profile.h>
+#include <ohmutil/VectorHash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace ohm
+{
+namespace
+{
+/// Heightmap regions in a single region column.
+struct GridColumn
+{
+  /// Keys of the regions in the column.
+  std::vector<glm::i16vec3> regions;
+  /// Maximum @c MapChunk::dirty_stamp of the @c regions .
+  uint64_t stamp = 0;
+};
+
+
+/// Strict weak ordering for region keys.
+bool regionKeyLess(const glm::i16vec3 &a, const glm::i16vec3 &b)
+{
+  return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z)));
+}
+
+
+/// Extract the @p block for @p column from the @p heightmap .
+void extractBlock(HeightmapGridBlock &block, GridColumn &column, const Heightmap &heightmap, const glm::ivec3 &axes,
+                  const glm::dvec3 &origin)
+{
+  const OccupancyMap &heightmap_occupancy = heightmap.heightmap();
+  const glm::u8vec3 region_dim = heightmap_occupancy.regionVoxelDimensions();
+  const glm::dvec3 &up = heightmap.upAxisNormal();
+  const unsigned cell_count = unsigned(region_dim[axes[0]]) * unsigned(region_dim[axes[1]]);
+
+  // Layers are stacked along the up axis.
+  std::sort(column.regions.begin(), column.regions.end(), regionKeyLess);
+
+  block.stamp = column.stamp;
+  block.layer_offsets.clear();
+  block.height.clear();
+  block.clearance.clear();
+  block.type.clear();
+  block.layer.clear();
+  block.layer_offsets.reserve(cell_count + 1);
+
+  glm::dvec3 pos;
+  for (int b = 0; b < int(region_dim[axes[1]]); ++b)
+  {
+    for (int a = 0; a < int(region_dim[axes[0]]); ++a)
+    {
+      block.layer_offsets.emplace_back(uint32_t(block.type.size()));
+      glm::u8vec3 local_key(0);
+      local_key[axes[0]] = uint8_t(a);
+      local_key[axes[1]] = uint8_t(b);
+      for (const glm::i16vec3 &region_key : column.regions)
+      {
+        HeightmapVoxel voxel_info{};
+        const HeightmapVoxelType voxel_type =
+          heightmap.getHeightmapVoxelInfo(Key(region_key, local_key), &pos, &voxel_info);
+        if (voxel_type != HeightmapVoxelType::kUnknown)
+        {
+          block.height.emplace_back(float(glm::dot(up, pos - origin)));
+          block.clearance.emplace_back(voxel_info.clearance);
+          block.type.emplace_back(voxel_type);
+          block.layer.emplace_back(voxel_info.layer);
+        }
+      }
+    }
+  }
+  block.layer_offsets.emplace_back(uint32_t(block.type.size()));
+}
+}  // namespace
+
+
+HeightmapGrid::HeightmapGrid() = default;
+
+
+size_t HeightmapGrid::update(const Heightmap &heightmap)
+{
+  PROFILE(HeightmapGrid_update);
+  const OccupancyMap &heightmap_occupancy = heightmap.heightmap();
+  const glm::ivec3 axes(heightmap.surfaceAxisIndexA(), heightmap.surfaceAxisIndexB(), heightmap.upAxisIndex());
+  const glm::u8vec3 region_dim = heightmap_occupancy.regionVoxelDimensions();
+  const glm::ivec2 block_dim(region_dim[axes[0]], region_dim[axes[1]]);
+
+  // Extract everything when the heightmap or its layout differs from the last call.
+  const bool extract_all = source_ != &heightmap_occupancy || axes_ != axes || block_dim_ != block_dim ||
+                           resolution_ != heightmap_occupancy.resolution() || origin_ != heightmap_occupancy.origin();
+  source_ = &heightmap_occupancy;
+  axes_ = axes;
+  block_dim_ = block_dim;
+  resolution_ = heightmap_occupancy.resolution();
+  origin_ = heightmap_occupancy.origin();
+  cell_origin_ = heightmap_occupancy.regionSpatialMin(glm::i16vec3(0));
+
+  // Collect the heightmap regions into columns.
+  std::vector<const MapChunk *> chunks;
+  heightmap_occupancy.enumerateRegions(chunks);
+  std::unordered_map<glm::i16vec3, GridColumn, Vector3Hash<glm::i16vec3>> columns;
+  for (const MapChunk *chunk : chunks)
+  {
+    glm::i16vec3 column_key = chunk->region.coord;
+    column_key[axes[2]] = 0;
+    GridColumn &column = columns[column_key];
+    column.regions.emplace_back(chunk->region.coord);
+    column.stamp = std::max<uint64_t>(column.stamp, chunk->dirty_stamp);
+  }
+
+  std::vector<glm::i16vec3> column_keys;
+  column_keys.reserve(columns.size());
+  for (const auto &column : columns)
+  {
+    column_keys.emplace_back(column.first);
+  }
+  std::sort(column_keys.begin(), column_keys.end(), regionKeyLess);
+
+  // Map existing blocks for reuse.
+  std::unordered_map<glm::i16vec3, size_t, Vector3Hash<glm::i16vec3>> existing_blocks;
+  for (size_t i = 0; i < blocks_.size(); ++i)
+  {
+    existing_blocks.emplace(blocks_[i].region_key, i);
+  }
+
+  std::vector<HeightmapGridBlock> blocks;
+  blocks.reserve(column_keys.size());
+  glm::ivec2 min_block(0);
+  glm::ivec2 max_block(-1);
+  size_t extracted_count = 0;
+  for (const glm::i16vec3 &column_key : column_keys)
+  {
+    GridColumn &column = columns[column_key];
+    const auto existing = existing_blocks.find(column_key);
+    if (!extract_all && existing != existing_blocks.end() && blocks_[existing->second].stamp == column.stamp)
+    {
+      // Unchanged.
+      blocks.emplace_back(std::move(blocks_[existing->second]));
+    }
+    else
+    {
+      blocks.emplace_back();
+      blocks.back().region_key = column_key;
+      extractBlock(blocks.back(), column, heightmap, axes, origin_);
+      ++extracted_count;
+    }
+
+    const glm::ivec2 block_coord(column_key[axes[0]], column_key[axes[1]]);
+    if (blocks.size() > 1)
+    {
+      min_block = glm::min(min_block, block_coord);
+      max_block = glm::max(max_block, block_coord);
+    }
+    else
+    {
+      min_block = max_block = block_coord;
+    }
+  }
+
+  blocks_ = std::move(blocks);
+
+  // Build the block lookup table.
+  min_block_ = min_block;
+  table_dim_ = max_block - min_block + glm::ivec2(1);
+  block_table_.clear();
+  block_table_.resize(size_t(table_dim_.x) * size_t(table_dim_.y), -1);
+  for (size_t i = 0; i < blocks_.size(); ++i)
+  {
+    const glm::ivec2 block_coord =
+      glm::ivec2(blocks_[i].region_key[axes[0]], blocks_[i].region_key[axes[1]]) - min_block_;
+    block_table_[size_t(block_coord.y) * size_t(table_dim_.x) + size_t(block_coord.x)] = int(i);
+  }
+
+  return extracted_count;
+}
+
+
+void HeightmapGrid::clear()
+{
+  blocks_.clear();
+  block_table_.clear();
+  min_block_ = table_dim_ = glm::ivec2(0);
+  source_ = nullptr;
+}
+
+
+bool HeightmapGrid::blockRange(glm::ivec2 *min_block, glm::ivec2 *max_block) const
+{
+  if (blocks_.empty())
+  {
+    return false;
+  }
+
+  *min_block = min_block_;
+  *max_block = min_block_ + table_dim_ - glm::ivec2(1);
+  return true;
+}
+
+
+glm::ivec2 HeightmapGrid::cellCoord(const glm::dvec3 &pos) const
+{
+  return glm::ivec2(int(std::floor((pos[axes_[0]] - cell_origin_[axes_[0]]) / resolution_)),
+                    int(std::floor((pos[axes_[1]] - cell_origin_[axes_[1]]) / resolution_)));
+}
+
+
+glm::dvec3 HeightmapGrid::cellCentre(const glm::ivec2 &cell) const
+{
+  glm::dvec3 centre(0.0);
+  centre[axes_[0]] = cell_origin_[axes_[0]] + (cell.x + 0.5) * resolution_;
+  centre[axes_[1]] = cell_origin_[axes_[1]] + (cell.y + 0.5) * resolution_;
+  return centre;
+}
+}  // namespace ohm
@@ -0,0 +1,186 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMHEIGHTMAP_HEIGHTMAPGRID_H
+#define OHMHEIGHTMAP_HEIGHTMAPGRID_H
+
+#include "OhmHeightmapConfig.h"
+
+#include "HeightmapVoxelType.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+class Heightmap;
+class OccupancyMap;
+
+/// A block of @c HeightmapGrid cells covering one @c Heightmap::heightmap() region column.
+///
+/// The cell data are stored as structure of arrays, with one entry per heightmap layer. The entries for a cell are
+/// given by the range [@c layer_offsets[cell_index], @c layer_offsets[cell_index + 1]) where the @c cell_index is
+/// given by @c HeightmapGrid::cellIndex() . For a non-layered heightmap, each cell has at most one entry.
+struct ohmheightmap_API HeightmapGridBlock
+{
+  /// Key of the heightmap region covered by the block. The up axis component is always zero.
+  glm::i16vec3 region_key = glm::i16vec3(0);
+  /// Maximum @c MapChunk::dirty_stamp of the region column when the block was extracted.
+  uint64_t stamp = 0;
+  /// Offsets into the entry arrays for each cell. Has one more item than there are cells in the block.
+  std::vector<uint32_t> layer_offsets;
+  /// Height of each entry along the up axis, relative to the heightmap origin.
+  std::vector<float> height;
+  /// Clearance above each entry - see @c HeightmapVoxel::clearance .
+  std::vector<float> clearance;
+  /// The @c HeightmapVoxelType of each entry. @c HeightmapVoxelType::kUnknown entries are omitted.
+  std::vector<HeightmapVoxelType> type;
+  /// The @c HeightmapVoxel::layer of each entry.
+  std::vector<uint8_t> layer;
+};
+
+/// A flattened, read only copy of a @c Heightmap for fast cell queries, such as those made by path planners.
+///
+/// Querying cells via @c Heightmap::getHeightmapVoxelInfo() involves resolving the key and reading the voxel layers
+/// from the heightmap @c OccupancyMap for each query. The @c HeightmapGrid instead extracts the height, clearance,
+/// voxel type and layer of each cell into contiguous arrays, supporting constant time cell lookup.
+///
+/// Cells are addressed by 2D cell coordinates along the heightmap surface axes, @c Heightmap::surfaceAxisIndexA()
+/// and @c Heightmap::surfaceAxisIndexB() . Cell coordinates are global voxel indices, which are stable across updates.
+/// The grid is stored in @c HeightmapGridBlock blocks, one per heightmap region column. @c update() only re-extracts
+/// blocks for which the heightmap regions have changed - see @c MapChunk::dirty_stamp - so the grid may be cheaply
+/// refreshed after @c Heightmap::updateHeightmap() .
+///
+/// Typical usage:
+/// @code
+/// ohm::HeightmapGrid grid;
+/// grid.update(heightmap);
+/// const glm::ivec2 cell = grid.cellCoord(position);
+/// unsigned begin, end;
+/// if (const ohm::HeightmapGridBlock *block = grid.cellLayers(cell, &begin, &end))
+/// {
+///   for (unsigned i = begin; i < end; ++i)
+///   {
+///     // Use block->height[i], block->clearance[i], ...
+///   }
+/// }
+/// @endcode
+class ohmheightmap_API HeightmapGrid
+{
+public:
+  /// Constructor, creating an empty grid.
+  HeightmapGrid();
+
+  /// Extract or refresh the grid from @p heightmap . Only blocks for which the heightmap regions have changed since
+  /// the last call are extracted, unless the @p heightmap differs from the last call.
+  /// @param heightmap The heightmap to extract.
+  /// @return The number of blocks extracted.
+  size_t update(const Heightmap &heightmap);
+
+  /// Clear the grid. The next @c update() extracts all blocks.
+  void clear();
+
+  /// Query the number of cells along each surface axis in each block. Matches the heightmap region dimensions.
+  /// @return The block dimensions.
+  inline const glm::ivec2 &blockDimensions() const { return block_dim_; }
+
+  /// Query the inclusive range of the block coordinates in the grid.
+  /// @param[out] min_block The minimum block coordinates. Matches the region key along the surface axes.
+  /// @param[out] max_block The maximum block coordinates.
+  /// @return False if the grid is empty.
+  bool blockRange(glm::ivec2 *min_block, glm::ivec2 *max_block) const;
+
+  /// Query the blocks in the grid.
+  /// @return The grid blocks, sorted by @c HeightmapGridBlock::region_key .
+  inline const std::vector<HeightmapGridBlock> &blocks() const { return blocks_; }
+
+  /// Convert a spatial position into a cell coordinate.
+  /// @param pos The position of interest. The up axis component is ignored.
+  /// @return The cell coordinate containing @p pos .
+  glm::ivec2 cellCoord(const glm::dvec3 &pos) const;
+
+  /// Calculate the position of the centre of a cell on the heightmap plane.
+  /// @param cell The cell coordinate.
+  /// @return The cell centre with a zero up axis component.
+  glm::dvec3 cellCentre(const glm::ivec2 &cell) const;
+
+  /// Resolve the block containing @p cell .
+  /// @param cell The cell coordinate.
+  /// @return The block containing @p cell or null if the cell is outside the extracted heightmap.
+  inline const HeightmapGridBlock *block(const glm::ivec2 &cell) const
+  {
+    const glm::ivec2 block_coord = floorDiv(cell, block_dim_) - min_block_;
+    if (block_coord.x < 0 || block_coord.y < 0 || block_coord.x >= table_dim_.x || block_coord.y >= table_dim_.y)
+    {
+      return nullptr;
+    }
+    const int block_index = block_table_[size_t(block_coord.y) * size_t(table_dim_.x) + size_t(block_coord.x)];
+    return (block_index >= 0) ? &blocks_[block_index] : nullptr;
+  }
+
+  /// Calculate the index of @p cell within its @c HeightmapGridBlock , indexing @c HeightmapGridBlock::layer_offsets .
+  /// @param cell The cell coordinate.
+  /// @return The cell index within the block.
+  inline unsigned cellIndex(const glm::ivec2 &cell) const
+  {
+    const glm::ivec2 local = cell - floorDiv(cell, block_dim_) * block_dim_;
+    return unsigned(local.y * block_dim_.x + local.x);
+  }
+
+  /// Resolve the entries for @p cell .
+  /// @param cell The cell coordinate.
+  /// @param[out] begin Set to the index of the first entry for @p cell in the @c HeightmapGridBlock arrays.
+  /// @param[out] end Set to one past the last entry for @p cell .
+  /// @return The block containing the entries or null if the cell is outside the extracted heightmap.
+  inline const HeightmapGridBlock *cellLayers(const glm::ivec2 &cell, unsigned *begin, unsigned *end) const
+  {
+    const HeightmapGridBlock *cell_block = block(cell);
+    if (cell_block)
+    {
+      const unsigned index = cellIndex(cell);
+      *begin = cell_block->layer_offsets[index];
+      *end = cell_block->layer_offsets[index + 1];
+    }
+    else
+    {
+      *begin = *end = 0;
+    }
+    return cell_block;
+  }
+
+private:
+  /// Integer floor division for each component.
+  static inline glm::ivec2 floorDiv(const glm::ivec2 &value, const glm::ivec2 &divisor)
+  {
+    return glm::ivec2((value.x >= 0) ? value.x / divisor.x : -((-value.x - 1) / divisor.x) - 1,
+                      (value.y >= 0) ? value.y / divisor.y : -((-value.y - 1) / divisor.y) - 1);
+  }
+
+  /// Extracted blocks.
+  std::vector<HeightmapGridBlock> blocks_;
+  /// Maps block coordinates - relative to @c min_block_ - to indices into @c blocks_ . -1 marks an absent block.
+  std::vector<int> block_table_;
+  /// Minimum block coordinates.
+  glm::ivec2 min_block_ = glm::ivec2(0);
+  /// Dimensions of @c block_table_ .
+  glm::ivec2 table_dim_ = glm::ivec2(0);
+  /// Dimensions of each block in cells. Initialised to avoid division by zero.
+  glm::ivec2 block_dim_ = glm::ivec2(1);
+  /// Heightmap origin.
+  glm::dvec3 origin_ = glm::dvec3(0.0);
+  /// Spatial minimum corner of the cell at coordinate zero.
+  glm::dvec3 cell_origin_ = glm::dvec3(0.0);
+  /// Heightmap voxel resolution.
+  double resolution_ = 1.0;
+  /// Index of the heightmap surface axes and up axis respectively.
+  glm::ivec3 axes_ = glm::ivec3(0, 1, 2);
+  /// The heightmap used to extract the grid. Only used to detect a change of heightmap.
+  const OccupancyMap *source_ = nullptr;
+};
+}  // namespace ohm
+
+#endif  // OHMHEIGHTMAP_HEIGHTMAPGRID_H
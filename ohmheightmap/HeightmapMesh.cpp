@@ -14,6 +14,7 @@
 #include <ohmheightmap/TriangleNeighbours.h>
 
 #include <ohm/Aabb.h>
+#include <ohm/MapChunk.h>
 #include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
 #include <ohm/OccupancyMap.h>
@@ -21,6 +22,7 @@
 
 #include <ohmutil/PlyMesh.h>
 #include <ohmutil/Profile.h>
+#include <ohmutil/VectorHash.h>
 
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
@@ -28,10 +30,53 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/normal.hpp>
 
+#include <unordered_map>
 #include <vector>
 
 namespace ohm
 {
+namespace
+{
+/// Add a triangle @p normal to the @p vertex_normals of the triangle @p indices according to the normals @p mode .
+void addTriangleNormal(HeightmapMesh::NormalsMode mode, std::vector<glm::vec3> &vertex_normals,
+                       const std::array<unsigned, 3> &indices, const glm::vec3 &normal, const glm::vec3 &up)
+{
+  // Vertex normals generated by considering all faces.
+  if (mode == HeightmapMesh::kNormalsAverage)
+  {
+    vertex_normals[indices[0]] += normal;
+    vertex_normals[indices[1]] += normal;
+    vertex_normals[indices[2]] += normal;
+  }
+  else if (mode == HeightmapMesh::kNormalsWorst)
+  {
+    // Vertex normals by least horizontal.
+    for (int j = 0; j < 3; ++j)
+    {
+      const glm::vec3 existing_normal = vertex_normals[indices[j]];
+      const float existing_dot = glm::dot(existing_normal, up);
+      const float new_dot = glm::dot(normal, up);
+      if (existing_normal == glm::vec3(0.0f) || existing_dot > new_dot)
+      {
+        // No existing normal or existing is more horizontal. Override.
+        vertex_normals[indices[j]] = normal;
+      }
+    }
+  }
+}
+
+
+/// Heightmap regions in a single region column, used by @c HeightmapMesh::buildTiles() .
+struct TileColumn
+{
+  /// Keys of the regions in the column.
+  std::vector<glm::i16vec3> regions;
+  /// Maximum @c MapChunk::dirty_stamp of the @c regions .
+  uint64_t stamp = 0;
+};
+}  // namespace
+
+
 class HeightmapMeshDetail
 {
 public:
@@ -48,6 +93,12 @@ public:
   /// Tight mesh extents exactly enclosing the mesh vertices.
   Aabb tight_mesh_extents = Aabb(0.0);
   double resolution = 0.0;
+  /// Tiles generated by @c HeightmapMesh::buildTiles() .
+  std::vector<HeightmapMeshTile> tiles;
+  /// Heightmap used to generate @c tiles . Only used to detect a change of heightmap.
+  const OccupancyMap *tiles_source = nullptr;
+  /// Normals mode used to generate @c tiles .
+  HeightmapMesh::NormalsMode tiles_normals_mode = HeightmapMesh::kNormalsAverage;
 
   void clear()
   {
@@ -239,28 +290,7 @@ bool HeightmapMesh::buildMesh(const Heightmap &heightmap, const MeshVoxelModifie
         imp_->edges.emplace_back(TriangleEdge(indices[1], indices[2], tri_count, 1));
         imp_->edges.emplace_back(TriangleEdge(indices[2], indices[0], tri_count, 2));
 
-        // Vertex normals generated by considering all faces.
-        if (imp_->normals_mode == kNormalsAverage)
-        {
-          imp_->vertex_normals[indices[0]] += normal;
-          imp_->vertex_normals[indices[1]] += normal;
-          imp_->vertex_normals[indices[2]] += normal;
-        }
-        else if (imp_->normals_mode == kNormalsWorst)
-        {
-          // Vertex normals by least horizontal.
-          for (int j = 0; j < 3; ++j)
-          {
-            const glm::vec3 existing_normal = imp_->vertex_normals[indices[j]];
-            const float existing_dot = glm::dot(existing_normal, upf);
-            const float new_dot = glm::dot(normal, upf);
-            if (existing_normal == glm::vec3(0.0f) || existing_dot > new_dot)
-            {
-              // No existing normal or existing is more horizontal. Override.
-              imp_->vertex_normals[indices[j]] = normal;
-            }
-          }
-        }
+        addTriangleNormal(imp_->normals_mode, imp_->vertex_normals, indices, normal, upf);
 
         imp_->tri_normals.push_back(normal);
         ++tri_count;
@@ -314,6 +344,214 @@ bool HeightmapMesh::buildMesh(const Heightmap &heightmap, const MeshVoxelModifie
 }
 
 
+size_t HeightmapMesh::buildTiles(const Heightmap &heightmap, const MeshVoxelModifier &voxel_modifier)
+{
+  PROFILE(HeightmapMesh_buildTiles);
+  const OccupancyMap &heightmap_occupancy = heightmap.heightmap();
+  const MapLayer *heightmap_layer = heightmap_occupancy.layout().layer(HeightmapVoxel::kHeightmapLayer);
+
+  if (!heightmap_layer)
+  {
+    // Fail.
+    imp_->tiles.clear();
+    return 0;
+  }
+
+  // Regenerate everything when the source or normals mode differs from the last call.
+  const bool rebuild_all = imp_->tiles_source != &heightmap_occupancy || imp_->tiles_normals_mode != imp_->normals_mode;
+  imp_->tiles_source = &heightmap_occupancy;
+  imp_->tiles_normals_mode = imp_->normals_mode;
+
+  const int up_axis_index = heightmap.upAxisIndex();
+  const int axis_a = heightmap.surfaceAxisIndexA();
+  const int axis_b = heightmap.surfaceAxisIndexB();
+  const glm::u8vec3 region_dim = heightmap_occupancy.regionVoxelDimensions();
+  const glm::vec3 upf(heightmap.upAxisNormal());
+
+  // Collect the heightmap regions into columns. Multi-layered heightmaps stack regions along the up axis.
+  std::vector<const MapChunk *> chunks;
+  heightmap_occupancy.enumerateRegions(chunks);
+  std::unordered_map<glm::i16vec3, TileColumn, Vector3Hash<glm::i16vec3>> columns;
+  for (const MapChunk *chunk : chunks)
+  {
+    glm::i16vec3 column_key = chunk->region.coord;
+    column_key[up_axis_index] = 0;
+    TileColumn &column = columns[column_key];
+    column.regions.emplace_back(chunk->region.coord);
+    column.stamp = std::max<uint64_t>(column.stamp, chunk->dirty_stamp);
+  }
+
+  std::vector<glm::i16vec3> tile_keys;
+  tile_keys.reserve(columns.size());
+  for (const auto &column : columns)
+  {
+    tile_keys.emplace_back(column.first);
+  }
+  std::sort(tile_keys.begin(), tile_keys.end(), [](const glm::i16vec3 &a, const glm::i16vec3 &b) {
+    return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z)));
+  });
+
+  // Map existing tiles for reuse.
+  std::unordered_map<glm::i16vec3, size_t, Vector3Hash<glm::i16vec3>> existing_tiles;
+  for (size_t i = 0; i < imp_->tiles.size(); ++i)
+  {
+    existing_tiles.emplace(imp_->tiles[i].region_key, i);
+  }
+
+  // Offsets to the columns contributing to a tile: the tile column, then the positive neighbours.
+  std::array<glm::i16vec3, 4> column_offsets;
+  column_offsets.fill(glm::i16vec3(0));
+  column_offsets[1][axis_a] = column_offsets[3][axis_a] = 1;
+  column_offsets[2][axis_b] = column_offsets[3][axis_b] = 1;
+
+  std::vector<HeightmapMeshTile> tiles;
+  tiles.reserve(tile_keys.size());
+  std::vector<const TileColumn *> tile_columns(column_offsets.size());
+  std::vector<glm::dvec3> points;
+  std::vector<double> coords_2d;
+  size_t rebuilt_count = 0;
+  for (const glm::i16vec3 &tile_key : tile_keys)
+  {
+    std::array<uint64_t, 4> stamps = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < column_offsets.size(); ++i)
+    {
+      const auto column_iter = columns.find(glm::i16vec3(tile_key + column_offsets[i]));
+      tile_columns[i] = (column_iter != columns.end()) ? &column_iter->second : nullptr;
+      stamps[i] = (tile_columns[i]) ? tile_columns[i]->stamp : 0u;
+    }
+
+    const auto existing = existing_tiles.find(tile_key);
+    if (!rebuild_all && existing != existing_tiles.end() && imp_->tiles[existing->second].source_stamps == stamps)
+    {
+      // Unchanged.
+      tiles.emplace_back(std::move(imp_->tiles[existing->second]));
+      tiles.back().dirty = false;
+      continue;
+    }
+
+    tiles.emplace_back();
+    HeightmapMeshTile &tile = tiles.back();
+    tile.region_key = tile_key;
+    tile.origin = heightmap_occupancy.regionSpatialMin(tile_key);
+    tile.source_stamps = stamps;
+    tile.dirty = true;
+    ++rebuilt_count;
+
+    // Collect vertices from the tile column and the first row of the neighbouring columns.
+    points.clear();
+    coords_2d.clear();
+    for (size_t i = 0; i < column_offsets.size(); ++i)
+    {
+      if (!tile_columns[i])
+      {
+        continue;
+      }
+
+      const int range_a = (column_offsets[i][axis_a]) ? 1 : region_dim[axis_a];
+      const int range_b = (column_offsets[i][axis_b]) ? 1 : region_dim[axis_b];
+      for (const glm::i16vec3 &region_key : tile_columns[i]->regions)
+      {
+        for (int b = 0; b < range_b; ++b)
+        {
+          for (int a = 0; a < range_a; ++a)
+          {
+            glm::u8vec3 local_key(0);
+            local_key[axis_a] = uint8_t(a);
+            local_key[axis_b] = uint8_t(b);
+            const Key key(region_key, local_key);
+
+            glm::dvec3 point;
+            HeightmapVoxel voxel_info;
+            auto voxel_type = heightmap.getHeightmapVoxelInfo(key, &point, &voxel_info);
+            if (voxel_modifier)
+            {
+              voxel_type = voxel_modifier(key, voxel_type, &point, &voxel_info.clearance);
+            }
+
+            if (voxel_type != HeightmapVoxelType::kUnknown && voxel_type != HeightmapVoxelType::kVacant)
+            {
+              points.emplace_back(point);
+              coords_2d.emplace_back(point[axis_a]);
+              coords_2d.emplace_back(point[axis_b]);
+            }
+          }
+        }
+      }
+    }
+
+    tile.vertices.reserve(points.size());
+    for (const glm::dvec3 &point : points)
+    {
+      tile.vertices.emplace_back(glm::vec3(point - tile.origin));
+    }
+    tile.vertex_normals.resize(points.size(), glm::vec3(0.0f));
+
+    // Need at least 3 points to triangulate.
+    if (points.size() < 3)
+    {
+      continue;
+    }
+
+    try
+    {
+      delaunator::Delaunator delaunay(coords_2d);
+      tile.indices.reserve(delaunay.triangles.size());
+      std::array<unsigned, 3> indices;
+      for (size_t i = 0; i < delaunay.triangles.size(); i += 3)
+      {
+        indices[0] = unsigned(delaunay.triangles[i + 0]);
+        indices[1] = unsigned(delaunay.triangles[i + 1]);
+        indices[2] = unsigned(delaunay.triangles[i + 2]);
+
+        glm::vec3 normal = glm::triangleNormal(points[indices[0]], points[indices[1]], points[indices[2]]);
+
+        // Adjust winding to match the heightmap axis.
+        if (glm::dot(normal, upf) < 0)
+        {
+          std::swap(indices[1], indices[2]);
+          normal *= -1.0f;
+        }
+
+        tile.indices.insert(tile.indices.end(), indices.begin(), indices.end());
+        addTriangleNormal(imp_->normals_mode, tile.vertex_normals, indices, normal, upf);
+      }
+
+      for (auto &vertex_normal : tile.vertex_normals)
+      {
+        vertex_normal = (vertex_normal != glm::vec3(0.0f)) ? glm::normalize(vertex_normal) : vertex_normal;
+      }
+    }
+    catch (const std::runtime_error &)
+    {
+      // Triangulation has failed. Can come about due to co-linear coordinates. Leave the tile without triangles.
+      tile.indices.clear();
+    }
+  }
+
+  imp_->tiles = std::move(tiles);
+  return rebuilt_count;
+}
+
+
+size_t HeightmapMesh::tileCount() const
+{
+  return imp_->tiles.size();
+}
+
+
+const HeightmapMeshTile *HeightmapMesh::tiles() const
+{
+  return imp_->tiles.data();
+}
+
+
+void HeightmapMesh::clearTiles()
+{
+  imp_->tiles.clear();
+  imp_->tiles_source = nullptr;
+}
+
+
 double HeightmapMesh::resolution() const
 {
   return imp_->resolution;
@@ -10,11 +10,14 @@
 
 #include "HeightmapVoxelType.h"
 
-#include <glm/fwd.hpp>
+#include <glm/glm.hpp>
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <vector>
 
 namespace ohm
 {
@@ -25,6 +28,30 @@ class Key;
 class PlyMesh;
 struct TriangleNeighbours;
 
+/// A tile of a @c HeightmapMesh generated by @c HeightmapMesh::buildTiles() .
+///
+/// Each tile covers the column of @c Heightmap::heightmap() regions at @c region_key and is an independent
+/// vertex/index buffer suitable for GPU upload. To join adjacent tiles without gaps, each tile also includes the first
+/// row of voxels of its neighbouring tiles along the positive surface axes.
+struct ohmheightmap_API HeightmapMeshTile
+{
+  /// Key of the heightmap region covered by the tile. The up axis component is always zero.
+  glm::i16vec3 region_key = glm::i16vec3(0);
+  /// The origin @c vertices are relative to: the minimum spatial extents of the region.
+  glm::dvec3 origin = glm::dvec3(0.0);
+  /// Single precision vertices relative to @c origin .
+  std::vector<glm::vec3> vertices;
+  /// Per vertex normals generated according to the @c HeightmapMesh::normalsMode() .
+  std::vector<glm::vec3> vertex_normals;
+  /// Triangle index triples into @c vertices .
+  std::vector<unsigned> indices;
+  /// @c MapChunk::dirty_stamp values of the heightmap regions contributing to the tile when it was built: the tile
+  /// region column followed by the neighbouring columns along the positive surface axes. Zero for missing regions.
+  std::array<uint64_t, 4> source_stamps = { 0, 0, 0, 0 };
+  /// True if the tile was regenerated by the last @c HeightmapMesh::buildTiles() call.
+  bool dirty = false;
+};
+
 /// A utility class for generating a triangle mesh from a @c Heightmap occupancy map.
 ///
 /// The mesh is generated in @c buildMesh() and provides the following data:
@@ -35,6 +62,9 @@ struct TriangleNeighbours;
 /// - Single precision per triangle normals.
 /// - Mesh axis aligned bounds.
 /// - Triangle neighbour information: see @c TriangleNeighbours.
+///
+/// Alternatively, @c buildTiles() generates the mesh as separate tiles - @c HeightmapMeshTile - one per heightmap
+/// region. Repeated calls only regenerate tiles for which the heightmap has changed.
 class ohmheightmap_API HeightmapMesh
 {
 public:
@@ -80,6 +110,32 @@ public:
   /// @return True on success.
   bool buildMesh(const Heightmap &heightmap, const MeshVoxelModifier &voxel_modifier = MeshVoxelModifier());
 
+  /// Build or update the mesh tiles for @p heightmap . This is independent of @c buildMesh() .
+  ///
+  /// A tile is only regenerated when the @c MapChunk::dirty_stamp of any contributing heightmap region has changed
+  /// since the last call, when the tile is new, or when the @c heightmap or @c normalsMode() differs from the previous
+  /// call. Regenerated tiles are marked @c HeightmapMeshTile::dirty . Tiles for which the heightmap region no longer
+  /// exists are removed. Tiles are sorted by @c HeightmapMeshTile::region_key .
+  ///
+  /// The @p voxel_modifier is only applied to regenerated tiles. Call @c clearTiles() to regenerate all tiles when
+  /// changing the @p voxel_modifier behaviour.
+  ///
+  /// @param heightmap The heightmap to generate mesh tiles for.
+  /// @param voxel_modifier Optional modifier function applied to each voxel before moving it to the mesh.
+  /// @return The number of tiles regenerated.
+  size_t buildTiles(const Heightmap &heightmap, const MeshVoxelModifier &voxel_modifier = MeshVoxelModifier());
+
+  /// Query the number of tiles generated by @c buildTiles() .
+  /// @return The tile count.
+  size_t tileCount() const;
+
+  /// Get the tile array generated by @c buildTiles() . The number of tiles is given by @c tileCount() .
+  /// @return A pointer to the tile array.
+  const HeightmapMeshTile *tiles() const;
+
+  /// Clear the tiles generated by @c buildTiles() , regenerating all tiles on the next call.
+  void clearTiles();
+
   /// Get the voxel resolution fo the heightmap from which the last mesh was generated.
   /// @return The heightmap voxel resolution.
   double resolution() const;
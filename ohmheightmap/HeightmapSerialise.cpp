@@ -6,11 +6,30 @@
 #include "HeightmapSerialise.h"
 
 #include "Heightmap.h"
+#include "HeightmapUtil.h"
+#include "HeightmapVoxel.h"
 
 #include "private/HeightmapDetail.h"
 
+#include <ohm/MapChunk.h>
 #include <ohm/MapInfo.h>
+#include <ohm/MapLayout.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/VoxelBlock.h>
+#include <ohm/VoxelBuffer.h>
+#include <ohm/VoxelOccupancy.h>
+
+#ifdef OHM_FEATURE_LZ4
+#include <lz4.h>
+#endif  // OHM_FEATURE_LZ4
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
 
 namespace
 {
@@ -19,14 +38,211 @@ struct RegisterExtensionCodes
   RegisterExtensionCodes()
   {
     ohm::registerSerialiseExtensionErrorCodeString(int(ohm::kSeHeightmapInfoMismatch), "heightmap info mismatch");
+    ohm::registerSerialiseExtensionErrorCodeString(int(ohm::kSeHeightmapCompactCorrupt), "compact heightmap corrupt");
+    ohm::registerSerialiseExtensionErrorCodeString(int(ohm::kSeHeightmapCompactUnsupported),
+                                                   "compact heightmap compression unsupported");
   }
 };
 
 const RegisterExtensionCodes s_register_heightmap_errors;
+
+// Compact heightmap format:
+// - Header: see encodeCompact().
+// - Tiles: one per heightmap region. Each tile has a fixed header followed by the tile payload, which may be
+//   compressed. The uncompressed payload is a presence bit mask over the region voxels, followed by arrays with one
+//   entry per present cell, in voxel index order: cell type (uint8), quantised height (uint16) and quantised clearance
+//   (uint16). Storing each field contiguously improves compression.
+const uint32_t kCompactMagic = 0x434d484fu;  // "OHMC"
+const uint16_t kCompactVersion = 1u;
+
+// Cell type bits.
+const uint8_t kCellTypeMask = 0x3u;
+const uint8_t kCellSurface = 1u;
+const uint8_t kCellVirtualSurface = 2u;
+const uint8_t kCellVacant = 3u;
+const unsigned kCellLayerShift = 2u;
+const uint8_t kCellLayerMask = 0x3u;
+const uint8_t kCellObservedAbove = (1u << 4u);
+
+// Header flag bits.
+const uint8_t kFlagIgnoreVoxelMean = (1u << 0u);
+const uint8_t kFlagVirtualSurface = (1u << 1u);
+const uint8_t kFlagPromoteVirtualBelow = (1u << 2u);
+
+/// Bytes per present cell in the tile payload.
+const size_t kCellByteSize = sizeof(uint8_t) + 2 * sizeof(uint16_t);
+
+template <typename T>
+void appendValue(std::vector<uint8_t> &buffer, const T &value)
+{
+  const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+
+/// Bounds checked sequential reads from a byte buffer.
+class BufferReader
+{
+public:
+  BufferReader(const uint8_t *data, size_t byte_count)
+    : pos_(data)
+    , end_(data + byte_count)
+  {}
+
+  template <typename T>
+  bool read(T *value)
+  {
+    if (remaining() < sizeof(T))
+    {
+      return false;
+    }
+    std::memcpy(value, pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  const uint8_t *skip(size_t byte_count)
+  {
+    if (remaining() < byte_count)
+    {
+      return nullptr;
+    }
+    const uint8_t *at = pos_;
+    pos_ += byte_count;
+    return at;
+  }
+
+  size_t remaining() const { return size_t(end_ - pos_); }
+
+private:
+  const uint8_t *pos_;
+  const uint8_t *end_;
+};
+
+
+uint16_t quantise(double value, double quantum)
+{
+  const double steps = std::round(value / quantum);
+  return uint16_t(std::max(0.0, std::min(steps, double(std::numeric_limits<uint16_t>::max()))));
+}
+
+
+uint8_t encodeCellType(float occupancy, const ohm::HeightmapVoxel &voxel)
+{
+  uint8_t type = kCellVacant;
+  if (occupancy > ohm::Heightmap::kHeightmapVacantValue)
+  {
+    type = kCellSurface;
+  }
+  else if (occupancy < ohm::Heightmap::kHeightmapVacantValue)
+  {
+    type = kCellVirtualSurface;
+  }
+  type |= uint8_t((voxel.layer & kCellLayerMask) << kCellLayerShift);
+  if (voxel.flags & ohm::kHvfObservedAbove)
+  {
+    type |= kCellObservedAbove;
+  }
+  return type;
+}
+
+
+float decodeCellOccupancy(uint8_t type)
+{
+  switch (type & kCellTypeMask)
+  {
+  case kCellSurface:
+    return ohm::Heightmap::kHeightmapSurfaceValue;
+  case kCellVirtualSurface:
+    return ohm::Heightmap::kHeightmapVirtualSurfaceValue;
+  default:
+    break;
+  }
+  return ohm::Heightmap::kHeightmapVacantValue;
+}
+
+
+/// Compress a tile payload.
+/// @return True on success, false if compression failed or did not reduce the size.
+bool compressTile(const std::vector<uint8_t> &raw, ohm::HeightmapTileCompression compression,
+                  std::vector<uint8_t> &packed)
+{
+  switch (compression)
+  {
+#ifdef OHM_FEATURE_LZ4
+  case ohm::HeightmapTileCompression::kLz4: {
+    packed.resize(size_t(LZ4_compressBound(int(raw.size()))));
+    const int packed_size = LZ4_compress_default(reinterpret_cast<const char *>(raw.data()),
+                                                 reinterpret_cast<char *>(packed.data()), int(raw.size()),
+                                                 int(packed.size()));
+    if (packed_size <= 0)
+    {
+      return false;
+    }
+    packed.resize(size_t(packed_size));
+    break;
+  }
+#endif  // OHM_FEATURE_LZ4
+  case ohm::HeightmapTileCompression::kDeflate: {
+    auto packed_size = uLongf(compressBound(uLong(raw.size())));
+    packed.resize(size_t(packed_size));
+    if (compress2(packed.data(), &packed_size, raw.data(), uLong(raw.size()), Z_BEST_SPEED) != Z_OK)
+    {
+      return false;
+    }
+    packed.resize(size_t(packed_size));
+    break;
+  }
+  default:
+    return false;
+  }
+
+  return packed.size() < raw.size();
+}
+
+
+/// Decompress a tile payload into @p raw , which must be sized for the uncompressed payload.
+int decompressTile(const uint8_t *packed, size_t packed_size, ohm::HeightmapTileCompression compression,
+                   std::vector<uint8_t> &raw)
+{
+  switch (compression)
+  {
+  case ohm::HeightmapTileCompression::kLz4:
+#ifdef OHM_FEATURE_LZ4
+    if (LZ4_decompress_safe(reinterpret_cast<const char *>(packed), reinterpret_cast<char *>(raw.data()),
+                            int(packed_size), int(raw.size())) != int(raw.size()))
+    {
+      return ohm::kSeHeightmapCompactCorrupt;
+    }
+    return ohm::kSeOk;
+#else   // OHM_FEATURE_LZ4
+    return ohm::kSeHeightmapCompactUnsupported;
+#endif  // OHM_FEATURE_LZ4
+  case ohm::HeightmapTileCompression::kDeflate: {
+    auto raw_size = uLongf(raw.size());
+    if (uncompress(raw.data(), &raw_size, packed, uLong(packed_size)) != Z_OK || raw_size != raw.size())
+    {
+      return ohm::kSeHeightmapCompactCorrupt;
+    }
+    return ohm::kSeOk;
+  }
+  default:
+    break;
+  }
+  return ohm::kSeHeightmapCompactCorrupt;
+}
 }  // namespace
 
 namespace ohm
 {
+int save(const std::string &filename, const Heightmap &heightmap, SerialiseProgress *progress)
+{
+  OccupancyMap &map = heightmap.heightmap();
+  heightmap.updateMapInfo(map.mapInfo());
+  return save(filename, map, progress);
+}
+
+
 int load(const std::string &filename, Heightmap &heightmap, SerialiseProgress *progress, MapVersion *version_out)
 {
   HeightmapDetail &detail = *heightmap.detail();
@@ -48,4 +264,356 @@ int load(const std::string &filename, Heightmap &heightmap, SerialiseProgress *p
 
   return err;
 }
+
+
+int encodeCompact(const Heightmap &heightmap, std::vector<uint8_t> &buffer, const HeightmapCompactOptions &options)
+{
+  const HeightmapDetail &detail = *heightmap.detail();
+  const OccupancyMap &map = *detail.heightmap;
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int voxel_layer = detail.heightmap_voxel_layer;
+  if (occupancy_layer < 0 || voxel_layer < 0)
+  {
+    return kSeHeightmapInfoMismatch;
+  }
+
+  const double resolution = map.resolution();
+  const double height_quantum = (options.height_quantum > 0) ? options.height_quantum : resolution / 256.0;
+  const double clearance_quantum = (options.clearance_quantum > 0) ? options.clearance_quantum : resolution / 16.0;
+  HeightmapTileCompression compression = options.compression;
+#ifndef OHM_FEATURE_LZ4
+  if (compression == HeightmapTileCompression::kLz4)
+  {
+    compression = HeightmapTileCompression::kDeflate;
+  }
+#endif  // OHM_FEATURE_LZ4
+
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+  const unsigned volume = unsigned(region_dim.x) * unsigned(region_dim.y) * unsigned(region_dim.z);
+  const size_t mask_size = (volume + 7u) / 8u;
+
+  uint8_t flags = 0;
+  flags |= (detail.ignore_voxel_mean) ? kFlagIgnoreVoxelMean : 0u;
+  flags |= (detail.generate_virtual_surface) ? kFlagVirtualSurface : 0u;
+  flags |= (detail.promote_virtual_below) ? kFlagPromoteVirtualBelow : 0u;
+
+  buffer.clear();
+  appendValue<uint32_t>(buffer, kCompactMagic);
+  appendValue<uint16_t>(buffer, kCompactVersion);
+  appendValue<uint16_t>(buffer, 0u);
+  appendValue<double>(buffer, resolution);
+  appendValue<double>(buffer, map.origin().x);
+  appendValue<double>(buffer, map.origin().y);
+  appendValue<double>(buffer, map.origin().z);
+  appendValue<uint8_t>(buffer, region_dim.x);
+  appendValue<uint8_t>(buffer, region_dim.y);
+  appendValue<uint8_t>(buffer, region_dim.z);
+  appendValue<int8_t>(buffer, int8_t(detail.up_axis_id));
+  appendValue<uint8_t>(buffer, uint8_t(detail.mode));
+  appendValue<uint8_t>(buffer, flags);
+  appendValue<uint16_t>(buffer, 0u);
+  appendValue<uint32_t>(buffer, uint32_t(detail.virtual_surface_filter_threshold));
+  appendValue<double>(buffer, detail.ceiling);
+  appendValue<double>(buffer, detail.floor);
+  appendValue<double>(buffer, detail.min_clearance);
+  appendValue<double>(buffer, height_quantum);
+  appendValue<double>(buffer, clearance_quantum);
+  const size_t tile_count_offset = buffer.size();
+  appendValue<uint32_t>(buffer, 0u);
+
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  // Sort for a deterministic output.
+  std::sort(chunks.begin(), chunks.end(), [](const MapChunk *a, const MapChunk *b) {
+    const glm::i16vec3 &ka = a->region.coord;
+    const glm::i16vec3 &kb = b->region.coord;
+    return ka.z < kb.z || (ka.z == kb.z && (ka.y < kb.y || (ka.y == kb.y && ka.x < kb.x)));
+  });
+
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> packed;
+  uint32_t tile_count = 0;
+  for (const MapChunk *chunk : chunks)
+  {
+    VoxelBuffer<const VoxelBlock> occupancy_buffer(chunk->voxel_blocks[occupancy_layer]);
+    VoxelBuffer<const VoxelBlock> voxel_buffer(chunk->voxel_blocks[voxel_layer]);
+    const auto *occupancy = reinterpret_cast<const float *>(occupancy_buffer.voxelMemory());
+    const auto *voxels = reinterpret_cast<const HeightmapVoxel *>(voxel_buffer.voxelMemory());
+
+    // Find the present cells and the height range.
+    raw.assign(mask_size, 0u);
+    uint32_t cell_count = 0;
+    float height_base = std::numeric_limits<float>::max();
+    for (unsigned i = 0; i < volume; ++i)
+    {
+      if (occupancy[i] != unobservedOccupancyValue())
+      {
+        raw[i / 8u] = uint8_t(raw[i / 8u] | (1u << (i % 8u)));
+        height_base = std::min(height_base, voxels[i].height);
+        ++cell_count;
+      }
+    }
+
+    if (cell_count == 0)
+    {
+      continue;
+    }
+
+    const size_t types_offset = mask_size;
+    const size_t heights_offset = types_offset + cell_count;
+    const size_t clearance_offset = heights_offset + cell_count * sizeof(uint16_t);
+    raw.resize(mask_size + cell_count * kCellByteSize);
+    size_t cell = 0;
+    for (unsigned i = 0; i < volume; ++i)
+    {
+      if (occupancy[i] != unobservedOccupancyValue())
+      {
+        const HeightmapVoxel &voxel = voxels[i];
+        const uint16_t height = quantise(double(voxel.height) - double(height_base), height_quantum);
+        const uint16_t clearance = quantise(double(voxel.clearance), clearance_quantum);
+        raw[types_offset + cell] = encodeCellType(occupancy[i], voxel);
+        std::memcpy(&raw[heights_offset + cell * sizeof(uint16_t)], &height, sizeof(height));
+        std::memcpy(&raw[clearance_offset + cell * sizeof(uint16_t)], &clearance, sizeof(clearance));
+        ++cell;
+      }
+    }
+
+    HeightmapTileCompression encoding = compression;
+    if (encoding == HeightmapTileCompression::kNone || !compressTile(raw, encoding, packed))
+    {
+      encoding = HeightmapTileCompression::kNone;
+    }
+    const std::vector<uint8_t> &payload = (encoding != HeightmapTileCompression::kNone) ? packed : raw;
+
+    appendValue<int16_t>(buffer, chunk->region.coord.x);
+    appendValue<int16_t>(buffer, chunk->region.coord.y);
+    appendValue<int16_t>(buffer, chunk->region.coord.z);
+    appendValue<uint8_t>(buffer, uint8_t(encoding));
+    appendValue<uint8_t>(buffer, 0u);
+    appendValue<uint32_t>(buffer, cell_count);
+    appendValue<float>(buffer, height_base);
+    appendValue<uint32_t>(buffer, uint32_t(raw.size()));
+    appendValue<uint32_t>(buffer, uint32_t(payload.size()));
+    buffer.insert(buffer.end(), payload.begin(), payload.end());
+    ++tile_count;
+  }
+
+  std::memcpy(&buffer[tile_count_offset], &tile_count, sizeof(tile_count));
+  return kSeOk;
+}
+
+
+int decodeCompact(const uint8_t *data, size_t byte_count, Heightmap &heightmap)
+{
+  BufferReader reader(data, byte_count);
+
+  uint32_t magic = 0;
+  uint16_t version = 0;
+  uint16_t reserved16 = 0;
+  if (!reader.read(&magic) || magic != kCompactMagic || !reader.read(&version))
+  {
+    return kSeHeightmapCompactCorrupt;
+  }
+
+  if (version != kCompactVersion)
+  {
+    return kSeUnsupportedVersion;
+  }
+
+  double resolution = 0;
+  glm::dvec3 origin(0.0);
+  glm::u8vec3 region_dim(0);
+  int8_t up_axis = 0;
+  uint8_t mode = 0;
+  uint8_t flags = 0;
+  uint32_t virtual_surface_filter_threshold = 0;
+  double ceiling = 0;
+  double floor = 0;
+  double min_clearance = 0;
+  double height_quantum = 0;
+  double clearance_quantum = 0;
+  uint32_t tile_count = 0;
+  bool ok = reader.read(&reserved16) && reader.read(&resolution) && reader.read(&origin.x) &&
+            reader.read(&origin.y) && reader.read(&origin.z) && reader.read(&region_dim.x) &&
+            reader.read(&region_dim.y) && reader.read(&region_dim.z) && reader.read(&up_axis) && reader.read(&mode) &&
+            reader.read(&flags) && reader.read(&reserved16) && reader.read(&virtual_surface_filter_threshold) &&
+            reader.read(&ceiling) && reader.read(&floor) && reader.read(&min_clearance) &&
+            reader.read(&height_quantum) && reader.read(&clearance_quantum) && reader.read(&tile_count);
+  ok = ok && resolution > 0 && height_quantum > 0 && clearance_quantum > 0;
+  ok = ok && region_dim.x > 0 && region_dim.y > 0 && region_dim.z > 0;
+  ok = ok && up_axis >= int8_t(UpAxis::kNegZ) && up_axis <= int8_t(UpAxis::kZ);
+  ok = ok && mode >= uint8_t(HeightmapMode::kFirst) && mode <= uint8_t(HeightmapMode::kLast);
+  if (!ok)
+  {
+    return kSeHeightmapCompactCorrupt;
+  }
+
+  // Reset the heightmap with the encoded configuration, as for the Heightmap constructor.
+  HeightmapDetail &detail = *heightmap.detail();
+  detail.up_axis_id = UpAxis(up_axis);
+  detail.mode = HeightmapMode(mode);
+  detail.ceiling = ceiling;
+  detail.floor = floor;
+  detail.min_clearance = min_clearance;
+  detail.virtual_surface_filter_threshold = virtual_surface_filter_threshold;
+  detail.ignore_voxel_mean = (flags & kFlagIgnoreVoxelMean) != 0;
+  detail.generate_virtual_surface = (flags & kFlagVirtualSurface) != 0;
+  detail.promote_virtual_below = (flags & kFlagPromoteVirtualBelow) != 0;
+  detail.last_build = HeightmapBuildState();
+  detail.updateAxis();
+
+  detail.heightmap = std::make_unique<OccupancyMap>(resolution, region_dim, MapFlag::kNone);
+  detail.heightmap->setOrigin(origin);
+  detail.heightmap_voxel_layer = heightmap::setupHeightmap(*detail.heightmap, detail);
+  glm::u8vec3 multilayer_region_dim = region_dim;
+  multilayer_region_dim[detail.vertical_axis_index] = 4;
+  detail.multilayer_heightmap = std::make_unique<OccupancyMap>(resolution, multilayer_region_dim);
+  detail.multilayer_heightmap->setOrigin(origin);
+  heightmap::setupHeightmap(*detail.multilayer_heightmap, detail);
+
+  OccupancyMap &map = *detail.heightmap;
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int voxel_layer = detail.heightmap_voxel_layer;
+  const unsigned volume = unsigned(region_dim.x) * unsigned(region_dim.y) * unsigned(region_dim.z);
+  const size_t mask_size = (volume + 7u) / 8u;
+
+  std::vector<uint8_t> raw;
+  for (uint32_t t = 0; t < tile_count; ++t)
+  {
+    glm::i16vec3 region_key(0);
+    uint8_t encoding = 0;
+    uint8_t reserved8 = 0;
+    uint32_t cell_count = 0;
+    float height_base = 0;
+    uint32_t raw_size = 0;
+    uint32_t stored_size = 0;
+    ok = reader.read(&region_key.x) && reader.read(&region_key.y) && reader.read(&region_key.z) &&
+         reader.read(&encoding) && reader.read(&reserved8) && reader.read(&cell_count) && reader.read(&height_base) &&
+         reader.read(&raw_size) && reader.read(&stored_size);
+    ok = ok && cell_count <= volume && raw_size == mask_size + cell_count * kCellByteSize;
+    const uint8_t *stored = (ok) ? reader.skip(stored_size) : nullptr;
+    if (!stored)
+    {
+      return kSeHeightmapCompactCorrupt;
+    }
+
+    const uint8_t *payload = stored;
+    if (HeightmapTileCompression(encoding) == HeightmapTileCompression::kNone)
+    {
+      if (stored_size != raw_size)
+      {
+        return kSeHeightmapCompactCorrupt;
+      }
+    }
+    else
+    {
+      raw.resize(raw_size);
+      const int err = decompressTile(stored, stored_size, HeightmapTileCompression(encoding), raw);
+      if (err)
+      {
+        return err;
+      }
+      payload = raw.data();
+    }
+
+    const uint8_t *mask = payload;
+    const uint8_t *types = payload + mask_size;
+    const uint8_t *heights = types + cell_count;
+    const uint8_t *clearances = heights + cell_count * sizeof(uint16_t);
+
+    MapChunk *chunk = map.region(region_key, true);
+    VoxelBuffer<VoxelBlock> occupancy_buffer(chunk->voxel_blocks[occupancy_layer]);
+    VoxelBuffer<VoxelBlock> voxel_buffer(chunk->voxel_blocks[voxel_layer]);
+    auto *occupancy = reinterpret_cast<float *>(occupancy_buffer.voxelMemory());
+    auto *voxels = reinterpret_cast<HeightmapVoxel *>(voxel_buffer.voxelMemory());
+
+    uint32_t cell = 0;
+    for (unsigned i = 0; i < volume; ++i)
+    {
+      if (!(mask[i / 8u] & (1u << (i % 8u))))
+      {
+        continue;
+      }
+
+      if (cell >= cell_count)
+      {
+        return kSeHeightmapCompactCorrupt;
+      }
+
+      uint16_t height = 0;
+      uint16_t clearance = 0;
+      std::memcpy(&height, heights + cell * sizeof(uint16_t), sizeof(height));
+      std::memcpy(&clearance, clearances + cell * sizeof(uint16_t), sizeof(clearance));
+      const uint8_t type = types[cell];
+
+      HeightmapVoxel voxel{};
+      voxel.height = float(double(height_base) + double(height) * height_quantum);
+      voxel.clearance = float(double(clearance) * clearance_quantum);
+      voxel.layer = uint8_t((type >> kCellLayerShift) & kCellLayerMask);
+      voxel.flags = (type & kCellObservedAbove) ? uint8_t(kHvfObservedAbove) : uint8_t(0u);
+      occupancy[i] = decodeCellOccupancy(type);
+      voxels[i] = voxel;
+      chunk->updateFirstValid(i);
+      ++cell;
+    }
+
+    if (cell != cell_count)
+    {
+      return kSeHeightmapCompactCorrupt;
+    }
+
+    const uint64_t stamp = map.touch();
+    chunk->markDirty(stamp);
+    chunk->touched_stamps[occupancy_layer].store(stamp, std::memory_order_relaxed);
+    chunk->touched_stamps[voxel_layer].store(stamp, std::memory_order_relaxed);
+  }
+
+  detail.toMapInfo(map.mapInfo());
+  return kSeOk;
+}
+
+
+int saveCompact(const std::string &filename, const Heightmap &heightmap, const HeightmapCompactOptions &options)
+{
+  std::vector<uint8_t> buffer;
+  const int err = encodeCompact(heightmap, buffer, options);
+  if (err)
+  {
+    return err;
+  }
+
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out.is_open())
+  {
+    return kSeFileCreateFailure;
+  }
+
+  out.write(reinterpret_cast<const char *>(buffer.data()), std::streamsize(buffer.size()));
+  return (out.good()) ? kSeOk : kSeFileWriteFailure;
+}
+
+
+int loadCompact(const std::string &filename, Heightmap &heightmap)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+  if (!in.is_open())
+  {
+    return kSeFileOpenFailure;
+  }
+
+  const std::streamsize byte_count = in.tellg();
+  if (byte_count <= 0)
+  {
+    return kSeFileReadFailure;
+  }
+
+  std::vector<uint8_t> buffer(size_t(byte_count));
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(buffer.data()), byte_count))
+  {
+    return kSeFileReadFailure;
+  }
+
+  return decodeCompact(buffer.data(), buffer.size(), heightmap);
+}
 }  // namespace ohm
@@ -14,6 +14,7 @@
 
 #include <cinttypes>
 #include <string>
+#include <vector>
 
 namespace ohm
 {
@@ -24,8 +25,41 @@ enum HeightmapSerialisationError
 {
   /// @c MapInfo does not represent a heightmap.
   kSeHeightmapInfoMismatch = kSeExtensionCode + 1,
+  /// Compact heightmap data is malformed or truncated.
+  kSeHeightmapCompactCorrupt,
+  /// Compact heightmap tile compression is not supported by this build.
+  kSeHeightmapCompactUnsupported,
 };
 
+/// Tile compression options for the compact heightmap format. See @c saveCompact() .
+enum class HeightmapTileCompression : uint8_t
+{
+  kNone = 0,    ///< Store tiles uncompressed.
+  kLz4 = 1,     ///< LZ4 compressed tiles. Falls back to @c kDeflate when built without @c OHM_FEATURE_LZ4 .
+  kDeflate = 2  ///< Deflate (zlib) compressed tiles.
+};
+
+/// Options for the compact heightmap format. See @c saveCompact() .
+struct ohmheightmap_API HeightmapCompactOptions
+{
+  /// Height quantisation step. Zero selects 1/256 of the heightmap resolution. Heights are stored relative to the
+  /// lowest height in each tile and are clamped to 65535 steps above it.
+  double height_quantum = 0;
+  /// Clearance quantisation step. Zero selects 1/16 of the heightmap resolution. Clearance is clamped to 65535 steps.
+  double clearance_quantum = 0;
+  /// Tile compression.
+  HeightmapTileCompression compression = HeightmapTileCompression::kLz4;
+};
+
+/// Save a heightmap. This saves the @c Heightmap::heightmap() occupancy map after updating its @c MapInfo from the
+/// heightmap generation parameters. The result may be loaded using the @c load() overload below.
+/// @param filename The heightmap file path to save to.
+/// @param heightmap The heightmap to save.
+/// @param progress Optional progress reporting interface.
+/// @return @c kSeOk on success, or a @c SerialisationError code on failure.
+int ohmheightmap_API save(const std::string &filename, const Heightmap &heightmap,
+                          SerialiseProgress *progress = nullptr);
+
 /// Load a save heightmap into a @c Heightmap object. Saving can be done directly on the @c Occupancy map stored in
 /// @c Heightmap::heightmap() .
 /// @param filename The heightmap file path to load.
@@ -34,6 +68,50 @@ enum HeightmapSerialisationError
 /// @param[out] version_out Set to the map file version number if provided.
 int ohmheightmap_API load(const std::string &filename, Heightmap &heightmap, SerialiseProgress *progress = nullptr,
                           MapVersion *version_out = nullptr);
+
+/// Encode a heightmap in the compact tile format. This is much smaller and faster to load than the @c save() format,
+/// which stores the full @c Heightmap::heightmap() occupancy map.
+///
+/// Each heightmap region is encoded as a tile holding, for each observed cell only, the cell type - surface, virtual
+/// surface or vacant - the @c HeightmapVoxel::layer and @c kHvfObservedAbove flag, the quantised height and the
+/// quantised clearance. Multiple cells per column, as generated by the layered fill modes, are preserved. Tiles are
+/// individually compressed so they may be decoded independently. The heightmap generation parameters are stored in
+/// the header.
+///
+/// Surface normals and contributing sample counts are not stored. Heights and clearance are quantised as described
+/// by the @p options .
+///
+/// @param heightmap The heightmap to encode.
+/// @param[out] buffer Set to the encoded heightmap.
+/// @param options Encoding options.
+/// @return @c kSeOk on success, or a @c SerialisationError code on failure.
+int ohmheightmap_API encodeCompact(const Heightmap &heightmap, std::vector<uint8_t> &buffer,
+                                   const HeightmapCompactOptions &options = HeightmapCompactOptions());
+
+/// Decode a heightmap from the compact tile format generated by @c encodeCompact() .
+///
+/// The @p heightmap is reset with the encoded resolution, region size, origin and generation parameters before the
+/// tiles are decoded. Incremental updates restart with a full build.
+///
+/// @param data The encoded heightmap.
+/// @param byte_count Number of bytes in @p data .
+/// @param heightmap The heightmap to decode into.
+/// @return @c kSeOk on success, or a @c SerialisationError code on failure.
+int ohmheightmap_API decodeCompact(const uint8_t *data, size_t byte_count, Heightmap &heightmap);
+
+/// Save a heightmap to file in the compact tile format. See @c encodeCompact() .
+/// @param filename The file path to save to.
+/// @param heightmap The heightmap to save.
+/// @param options Encoding options.
+/// @return @c kSeOk on success, or a @c SerialisationError code on failure.
+int ohmheightmap_API saveCompact(const std::string &filename, const Heightmap &heightmap,
+                                 const HeightmapCompactOptions &options = HeightmapCompactOptions());
+
+/// Load a heightmap saved with @c saveCompact() . See @c decodeCompact() .
+/// @param filename The file path to load.
+/// @param heightmap The heightmap to load into.
+/// @return @c kSeOk on success, or a @c SerialisationError code on failure.
+int ohmheightmap_API loadCompact(const std::string &filename, Heightmap &heightmap);
 }  // namespace ohm
 
 #endif  // OHMHEIGHTMAP_HEIGHTMAPMAPSERIALISE_H
@@ -65,6 +65,13 @@ bool PlaneFillLayeredWalker::walkNext(Key &key)
 }
 
 
+void PlaneFillLayeredWalker::lookahead(const Key & /*key*/, std::vector<Key> &keys, size_t max_count) const
+{
+  const size_t count = std::min(max_count, open_list_.size());
+  keys.insert(keys.end(), open_list_.begin(), open_list_.begin() + std::ptrdiff_t(count));
+}
+
+
 size_t PlaneFillLayeredWalker::visit(const Key &key, PlaneWalkVisitMode mode, std::array<Key, 8> &added_neighbours)
 {
   size_t added = 0;
@@ -98,6 +98,13 @@ public:
   /// @return True if the key is valid, false if walking is complete.
   bool walkNext(Key &key);
 
+  /// Collect up to @p max_count keys which are expected to be walked after @p key , in walk order. This does not
+  /// modify the walker and is used to search ahead of the walk, such as for multi-threaded heightmap generation.
+  /// @param key The current walk key.
+  /// @param[out] keys Keys are appended to this container.
+  /// @param max_count Maximum number of keys to append.
+  void lookahead(const Key &key, std::vector<Key> &keys, size_t max_count) const;
+
   /// Call this function when visiting a voxel at the given @p key. The keys neighbouring @p key (on the walk plane)
   /// are added to the open list, provided they are not already on the open list. The added neighbouring keys are
   /// filled in @p neighbours with the number of neighbours added given in the return value.
@@ -62,6 +62,24 @@ bool PlaneFillWalker::walkNext(Key &key)
 }
 
 
+void PlaneFillWalker::lookahead(const Key & /*key*/, std::vector<Key> &keys, size_t max_count) const
+{
+  if (!glm::all(glm::greaterThan(key_range, glm::ivec3(0))))
+  {
+    return;
+  }
+
+  // Mirror walkNext() clamping.
+  const size_t count = std::min(max_count, open_list_.size());
+  for (size_t i = 0; i < count; ++i)
+  {
+    Key next_key = open_list_[i];
+    next_key.clampTo(min_ext_key, max_ext_key);
+    keys.emplace_back(next_key);
+  }
+}
+
+
 size_t PlaneFillWalker::visit(const Key &key, PlaneWalkVisitMode mode, std::array<Key, 8> &added_neighbours)
 {
   size_t added = 0;
@@ -50,4 +50,14 @@ bool PlaneWalker::walkNext(Key &key) const
 
   return true;
 }
+
+
+void PlaneWalker::lookahead(const Key &key, std::vector<Key> &keys, size_t max_count) const
+{
+  Key next_key = key;
+  for (size_t i = 0; i < max_count && walkNext(next_key); ++i)
+  {
+    keys.emplace_back(next_key);
+  }
+}
 }  // namespace ohm
@@ -14,6 +14,7 @@
 #include <ohm/Key.h>
 
 #include <array>
+#include <vector>
 
 namespace ohm
 {
@@ -64,6 +65,13 @@ public:
   /// @return True if the key is valid, false if walking is complete.
   bool walkNext(Key &key) const;
 
+  /// Collect up to @p max_count keys which are expected to be walked after @p key , in walk order. This does not
+  /// modify the walker and is used to search ahead of the walk, such as for multi-threaded heightmap generation.
+  /// @param key The current walk key.
+  /// @param[out] keys Keys are appended to this container.
+  /// @param max_count Maximum number of keys to append.
+  void lookahead(const Key &key, std::vector<Key> &keys, size_t max_count) const;
+
   /// For API compatibility. Does nothing.
   /// @return 0
   inline size_t visit(const Key & /*key*/, PlaneWalkVisitMode /*mode*/) { return 0u; }  // NOLINT
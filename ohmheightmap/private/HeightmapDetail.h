@@ -12,16 +12,59 @@
 #include "ohmheightmap/UpAxis.h"
 
 #include <ohm/Aabb.h>
+#include <ohm/Key.h>
 
 #include <glm/glm.hpp>
 
 #include <memory>
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/task_arena.h>
+#endif  // OHM_FEATURE_THREADS
+
 namespace ohm
 {
 class OccupancyMap;
 class MapInfo;
 
+namespace heightmap
+{
+struct ColumnSearchCache;
+}  // namespace heightmap
+
+/// Records how the last heightmap was built, supporting @c Heightmap::updateHeightmap() .
+struct ohmheightmap_API HeightmapBuildState
+{
+  /// Source map used for the build.
+  const OccupancyMap *occupancy_map = nullptr;
+  /// The source map @c OccupancyMap::stamp() at the start of the build.
+  uint64_t stamp = 0;
+  /// Source map key of the reference position.
+  Key reference_key = Key(nullptr);
+  /// Minimum source map extents key.
+  Key min_ext_key = Key(nullptr);
+  /// Maximum source map extents key.
+  Key max_ext_key = Key(nullptr);
+  /// The @c Heightmap::buildHeightmap() cull extents.
+  Aabb cull_to = Aabb(0.0);
+  /// @c HeightmapDetail::ceiling at build time.
+  double ceiling = 0;
+  /// @c HeightmapDetail::floor at build time.
+  double floor = 0;
+  /// @c HeightmapDetail::min_clearance at build time.
+  double min_clearance = 0;
+  /// Supporting voxel flags derived from the generation parameters.
+  unsigned supporting_flags = 0;
+  /// @c HeightmapDetail::virtual_surface_filter_threshold at build time.
+  unsigned virtual_surface_filter_threshold = 0;
+  /// @c HeightmapDetail::mode at build time.
+  HeightmapMode mode = HeightmapMode::kPlanar;
+  /// @c HeightmapDetail::ignore_voxel_mean at build time.
+  bool ignore_voxel_mean = false;
+  /// True once a build has been recorded.
+  bool valid = false;
+};
+
 /// Pimpl data for @c Heightmap .
 struct ohmheightmap_API HeightmapDetail
 {
@@ -75,6 +118,20 @@ struct ohmheightmap_API HeightmapDetail
   /// Prefer a virtual surface below the reference position to a real surface above.
   /// @see @c Heightmap::setPromoteVirtualBelow()
   bool promote_virtual_below = false;
+  /// Number of threads to use in heightmap generation. Zero for all available, 1 to disable threads.
+  /// @see @c Heightmap::setThreadCount()
+  unsigned thread_count = 1;
+  /// Use a concurrent flood fill for layered fill modes when using multiple threads.
+  /// @see @c Heightmap::setConcurrentFill()
+  bool concurrent_fill = false;
+  /// Details of the last heightmap build used for incremental updates.
+  HeightmapBuildState last_build;
+  /// Column search results shared between the builds of a @c Heightmap::buildHeightmaps() call. Null otherwise.
+  heightmap::ColumnSearchCache *column_cache = nullptr;
+#ifdef OHM_FEATURE_THREADS
+  /// Task arena used to limit concurrency to a non-zero @c thread_count . Created on demand.
+  std::unique_ptr<tbb::task_arena> arena;
+#endif  // OHM_FEATURE_THREADS
 
   ~HeightmapDetail();
 
@@ -10,6 +10,7 @@
 #include "ohmheightmap/Heightmap.h"  // For TES_ENABLE
 #include "ohmheightmap/HeightmapVoxelType.h"
 
+#include <ohm/MapChunk.h>
 #include <ohm/OccupancyUtil.h>
 #include <ohm/Trace.h>  // For TES_ENABLE
 
@@ -20,6 +21,9 @@
 
 #include <glm/gtc/type_ptr.hpp>  // For TES_ENABLE
 
+#include <algorithm>
+#include <cstring>
+
 namespace ohm
 {
 namespace heightmap
@@ -29,6 +33,101 @@ const uint32_t kNeighbourIdMask = 0x80000000u;
 #endif  // TES_ENABLE
 
 
+namespace
+{
+/// Classify the given occupancy values into @c OccupancyType values. This is branch free to support vectorisation.
+/// @param values The occupancy values to classify.
+/// @param[out] types The classification output. Must have at least @p count elements.
+/// @param count The number of @p values .
+/// @param occupancy_threshold The occupancy threshold value.
+void classifyOccupancy(const float *values, int8_t *types, int count, float occupancy_threshold)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    const float value = values[i];
+    const int free = value < occupancy_threshold;
+    const int occupied = value >= occupancy_threshold && value != unobservedOccupancyValue();
+    types[i] = int8_t(int(kUnobserved) + free + 2 * occupied);
+  }
+}
+}  // namespace
+
+
+void SrcColumn::extract(SrcVoxel &voxel, const Key &key, const Key &min_key, const Key &max_key, int axis)
+{
+  PROFILE(extractColumn);
+  const OccupancyMap &map = voxel.map();
+  column_key = key;
+  vertical_axis = axis;
+  region_dim = map.regionVoxelDimensions()[axis];
+
+  const int min_coord = min_key.regionKey()[axis] * region_dim + min_key.localKey()[axis];
+  const int max_coord = max_key.regionKey()[axis] * region_dim + max_key.localKey()[axis];
+  base_coord = std::min(min_coord, max_coord) - 1;
+  const int count = std::max(min_coord, max_coord) + 1 - base_coord + 1;
+
+  const bool use_mean = voxel.mean.isLayerValid();
+  occupancy.resize(count);
+  types.resize(count);
+  mean_coords.resize(use_mean ? count : 0);
+
+  const glm::ivec3 layer_dim = voxel.occupancy.layerDim();
+  const VoxelOrder voxel_order = voxel.occupancy.layerVoxelOrder();
+  Key column_voxel_key = key;
+  for (int index = 0; index < count;)
+  {
+    // Resolve the region and the run of voxels in that region.
+    const int coord = base_coord + index;
+    const int region_coord = (coord >= 0) ? coord / region_dim : -((-coord - 1) / region_dim) - 1;
+    const int local_start = coord - region_coord * region_dim;
+    const int run = std::min(region_dim - local_start, count - index);
+    column_voxel_key.setRegionAxis(axis, int16_t(region_coord));
+    column_voxel_key.setLocalAxis(axis, uint8_t(local_start));
+
+    const MapChunk *chunk = map.region(column_voxel_key.regionKey());
+    const uint8_t *occupancy_memory = nullptr;
+    if (chunk)
+    {
+      voxel.occupancy.setKey(column_voxel_key, chunk);
+      occupancy_memory = voxel.occupancy.voxelMemory();
+    }
+
+    if (occupancy_memory)
+    {
+      glm::u8vec3 local = column_voxel_key.localKey();
+      for (int i = 0; i < run; ++i)
+      {
+        local[axis] = uint8_t(local_start + i);
+        const unsigned voxel_index = voxelIndex(local, layer_dim, voxel_order);
+        memcpy(&occupancy[index + i], occupancy_memory + voxel.occupancy.voxelStride() * voxel_index, sizeof(float));
+      }
+      classifyOccupancy(&occupancy[index], &types[index], run, voxel.occupancy_threshold);
+
+      if (use_mean)
+      {
+        voxel.mean.setKey(column_voxel_key, chunk);
+        const uint8_t *mean_memory = voxel.mean.voxelMemory();
+        for (int i = 0; i < run; ++i)
+        {
+          local[axis] = uint8_t(local_start + i);
+          const unsigned voxel_index = voxelIndex(local, layer_dim, voxel_order);
+          VoxelMean mean_info;
+          memcpy(&mean_info, mean_memory + voxel.mean.voxelStride() * voxel_index, sizeof(mean_info));
+          mean_coords[index + i] = mean_info.coord;
+        }
+      }
+    }
+    else
+    {
+      std::fill(occupancy.begin() + index, occupancy.begin() + index + run, unobservedOccupancyValue());
+      std::fill(types.begin() + index, types.begin() + index + run, int8_t(kNull));
+    }
+
+    index += run;
+  }
+}
+
+
 bool DstVoxel::haveRecordedHeight(double height, int up_axis_index, const glm::dvec3 &up) const
 {
   // Check if the current heightmap voxel has already recorded a result at the given height. Only call for valid
@@ -183,6 +282,29 @@ OccupancyType sourceVoxelHeight(glm::dvec3 *voxel_position, double *height, SrcV
   return voxel_type;
 }
 
+
+OccupancyType sourceVoxelHeight(glm::dvec3 *voxel_position, double *height, SrcVoxel &voxel, const Key &key,
+                                const glm::dvec3 &up)
+{
+  const int index = voxel.column.indexOf(key);
+  if (index < 0)
+  {
+    voxel.setKey(key);
+    return sourceVoxelHeight(voxel_position, height, voxel, up);
+  }
+
+  const auto voxel_type = OccupancyType(voxel.column.types[index]);
+  *voxel_position = voxel.map().voxelCentreGlobal(key);
+  if (voxel_type == ohm::kOccupied && !voxel.column.mean_coords.empty())
+  {
+    // Determine the height offset for voxel.
+    *voxel_position += subVoxelToLocalCoord<glm::dvec3>(voxel.column.mean_coords[index], voxel.map().resolution());
+  }
+  *height = glm::dot(*voxel_position, up);
+
+  return voxel_type;
+}
+
 Key findNearestSupportingVoxel2(SrcVoxel &voxel, const Key &from_key, const Key &to_key, int up_axis_index,
                                 int step_limit, bool search_up, unsigned flags, int *offset, bool *is_virtual)
 {
@@ -212,8 +334,8 @@ Key findNearestSupportingVoxel2(SrcVoxel &voxel, const Key &from_key, const Key
     // of a virtual surface, but not count it as part of our traversal. This is in part because for a virtual surface
     // we report the supporting unobserved voxel, not the free voxel, for the next phase to detect (final reporting is
     // of the free voxel).
-    voxel.setKey(from_key);
-    last_unobserved = ohm::isUnobservedOrNull(voxel.occupancy);
+    const OccupancyType from_type = voxel.occupancyType(from_key);
+    last_unobserved = from_type == ohm::kUnobserved || from_type == ohm::kNull;
     last_key = from_key;
 
     // Now move the key up one voxel for the next iteration.
@@ -260,19 +382,12 @@ Key findNearestSupportingVoxel2(SrcVoxel &voxel, const Key &from_key, const Key
     // Search up   |   0 | 2 | 3 | 4 | 5 | 6 |
     // Search down |   1 | 2 | 3 | 4 | 5 | 6 |
     *offset = (i > 0) ? i + 1 : !search_up;
-    voxel.setKey(current_key);
 
-    // This line yields performance issues likely due to the stochastic memory access.
-    // For a true performance gain we'd have to access chunks linearly.
-    // Read the occupancy value for the voxel.
-    float occupancy = unobservedOccupancyValue();
-    if (voxel.occupancy.chunk())
-    {
-      voxel.occupancy.read(&occupancy);
-    }
-    // Categorise the voxel.
-    const bool occupied = occupancy >= voxel.occupancy_threshold && occupancy != unobservedOccupancyValue();
-    const bool free = occupancy < voxel.occupancy_threshold;
+    // Categorise the voxel. This reads from the extracted column where available to avoid the stochastic memory
+    // access of resolving each voxel.
+    const OccupancyType voxel_type = voxel.occupancyType(current_key);
+    const bool occupied = voxel_type == ohm::kOccupied;
+    const bool free = voxel_type == ohm::kFree;
     const bool unobserved = !occupied && !free;
 
     if (occupied)
@@ -318,7 +433,7 @@ Key findNearestSupportingVoxel2(SrcVoxel &voxel, const Key &from_key, const Key
 
     // Calculate the next voxel.
     int next_step = step;
-    if (!voxel.occupancy.chunk())
+    if (voxel_type == ohm::kNull)
     {
       // The current voxel is an empty chunk implying all unknown voxels. We will skip to the last voxel in this
       // chunk. We don't skip the whole chunk to allow the virtual voxel calculation to take effect.
@@ -447,9 +562,7 @@ bool findGround(GroundCandidate &ground, SrcVoxel &voxel, const Key &seed_key, c
        voxel.map().stepKey(key, up_axis_index, step_dir))
   {
     // PROFILE(column);
-    voxel.setKey(key);
-
-    const OccupancyType voxel_type = sourceVoxelHeight(&sub_voxel_pos, &height, voxel, imp.up);
+    const OccupancyType voxel_type = sourceVoxelHeight(&sub_voxel_pos, &height, voxel, key, imp.up);
 
     // We check the clearance and consider a new candidate if we have encountered an occupied voxel, or
     // we are considering virtual surfaces. When considering virtual surfaces, we also check clearance where we
@@ -19,9 +19,11 @@
 
 #include <glm/vec3.hpp>
 
+#include <cstdint>
 #include <iosfwd>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 namespace ohm
 {
@@ -62,6 +64,70 @@ enum SupportingVoxelFlag : unsigned
   kIgnoreVirtualAbove = (1u << 3u),
 };
 
+struct SrcVoxel;
+
+/// A contiguous copy of the source map voxel data for a single column, used to accelerate column searches.
+///
+/// The supporting voxel and ground searches step voxel by voxel up and down a column. Doing so through @c Voxel
+/// accessors resolves the @c MapChunk at each region step and reads one voxel at a time. Instead, @c extract() resolves
+/// each @c MapChunk in the column once, copying the occupancy and voxel mean values into contiguous arrays. The
+/// occupancy values are then classified in a single, branch free pass over the array, which the compiler can
+/// vectorise.
+struct SrcColumn
+{
+  /// Occupancy values along the column. Null regions are filled with @c unobservedOccupancyValue() .
+  std::vector<float> occupancy;
+  /// @c OccupancyType classification of each @c occupancy value. Null regions are marked @c kNull .
+  std::vector<int8_t> types;
+  /// @c VoxelMean::coord values along the column. Empty when not using voxel mean.
+  std::vector<uint32_t> mean_coords;
+  /// A key in the extracted column. Only the non-vertical axes are relevant.
+  Key column_key = Key(nullptr);
+  /// Vertical voxel coordinate - `region * region_dim + local` - of the first array entry.
+  int base_coord = 0;
+  /// Number of voxels in a region along the vertical axis.
+  int region_dim = 1;
+  /// Index of the vertical axis.
+  int vertical_axis = 2;
+
+  /// Extract the column containing @p key , covering the vertical range of @p min_key and @p max_key padded by one
+  /// voxel either side. The padding covers the supporting voxel search stepping one voxel beyond the extents.
+  /// @param voxel Source voxel accessor. The key references of the @c SrcVoxel layers are modified.
+  /// @param key A key in the column of interest.
+  /// @param min_key Min extents limits.
+  /// @param max_key Max extents limits.
+  /// @param axis Index of the vertical axis.
+  void extract(SrcVoxel &voxel, const Key &key, const Key &min_key, const Key &max_key, int axis);
+
+  /// Invalidate the extracted column. @c indexOf() will always fail afterwards.
+  inline void invalidate()
+  {
+    column_key = Key(nullptr);
+    types.clear();
+  }
+
+  /// Resolve the array index for @p key .
+  /// @param key The key of interest.
+  /// @return The index of @p key in the column arrays or -1 if @p key is not in the extracted column.
+  inline int indexOf(const Key &key) const
+  {
+    const int index = key.regionKey()[vertical_axis] * region_dim + key.localKey()[vertical_axis] - base_coord;
+    if (index < 0 || index >= int(types.size()))
+    {
+      return -1;
+    }
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (axis != vertical_axis && (key.regionKey()[axis] != column_key.regionKey()[axis] ||
+                                    key.localKey()[axis] != column_key.localKey()[axis]))
+      {
+        return -1;
+      }
+    }
+    return index;
+  }
+};
+
 /// Helper structure for managing voxel data access from the source heightmap.
 struct SrcVoxel
 {
@@ -69,6 +135,7 @@ struct SrcVoxel
   Voxel<const VoxelMean> mean;              ///< Voxel mean layer (optional)
   Voxel<const CovarianceVoxel> covariance;  ///< Covariance layer used for surface normal estimation (optional)
   float occupancy_threshold;                ///< Occupancy threshold cached from the source map.
+  SrcColumn column;                         ///< Extracted column data. See @c extractColumn() .
 
   SrcVoxel(const OccupancyMap &map, bool use_voxel_mean)
     : occupancy(&map, map.layout().occupancyLayer())
@@ -126,6 +193,32 @@ struct SrcVoxel
 
   /// Query the voxel centre for the current voxel.
   inline glm::dvec3 centre() const { return occupancy.map()->voxelCentreGlobal(occupancy.key()); }
+
+  /// Extract the column containing @p column_key for use in subsequent @c occupancyType(const Key &) and
+  /// @c sourceVoxelHeight() calls. See @c SrcColumn::extract() .
+  /// @param column_key A key in the column of interest.
+  /// @param min_key Min extents limits.
+  /// @param max_key Max extents limits.
+  /// @param axis Index of the vertical axis.
+  inline void extractColumn(const Key &column_key, const Key &min_key, const Key &max_key, int axis)
+  {
+    column.extract(*this, column_key, min_key, max_key, axis);
+  }
+
+  /// Query the occupancy classification of the voxel at @p key , using the extracted @c column where possible. The
+  /// current voxel key is only modified when @p key is not in the @c column .
+  /// @param key The key of the voxel of interest.
+  /// @return The voxel @c OccupancyType .
+  inline OccupancyType occupancyType(const Key &key)
+  {
+    const int index = column.indexOf(key);
+    if (index >= 0)
+    {
+      return OccupancyType(column.types[index]);
+    }
+    setKey(key);
+    return occupancyType();
+  }
 };
 
 /// A utility for tracking the voxel being written in the heightmap.
@@ -279,6 +372,19 @@ inline KeyRange &project(KeyRange *key_range, int vertical_axis_index)
 /// @return The @c OccupancyType of the source @p voxel .
 OccupancyType sourceVoxelHeight(glm::dvec3 *voxel_position, double *height, SrcVoxel &voxel, const glm::dvec3 &up);
 
+/// @overload
+///
+/// This overload considers the voxel at @p key , using the @c SrcVoxel::column data when @p key is in the extracted
+/// column. Otherwise the @p voxel key is set to @p key .
+/// @param[out] voxel_position The 3D position calculated for the voxel. May include @c VoxelMean if available.
+/// @param[out] height The height of @p voxel_position along the @p up axis.
+/// @param voxel The voxel details in the source occupancy map from which we are generating a heightmap.
+/// @param key The key of the voxel of interest.
+/// @param up The heightmap up axis.
+/// @return The @c OccupancyType of the source voxel.
+OccupancyType sourceVoxelHeight(glm::dvec3 *voxel_position, double *height, SrcVoxel &voxel, const Key &key,
+                                const glm::dvec3 &up);
+
 /// Calculate the height of the voxel at @p key with matching local @p height value.
 ///
 /// This calculates the centre of the voxel at @p key then calculates `dot(up, centre) + height`.
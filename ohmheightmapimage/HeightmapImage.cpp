@@ -5,6 +5,8 @@
 // Author: Kazys Stepanas
 #include "HeightmapImage.h"
 
+#include "private/HeightmapRasteriser.h"
+
 #include <ohmheightmap/HeightmapMesh.h>
 
 #include <ohm/MapLayer.h>
@@ -18,7 +20,9 @@
 #include <3esservermacros.h>
 
 #include <iostream>
+#include <limits>
 #include <mutex>
+#include <vector>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -363,6 +367,8 @@ struct HeightmapImageDetail
   HeightmapImage::ImageType desired_type = HeightmapImage::kImageNormals;
   HeightmapImage::ImageType generated_type = HeightmapImage::kImageNormals;
   unsigned pixels_per_voxel = 1;
+  /// The resolved rendering backend.
+  HeightmapImage::Backend backend = HeightmapImage::kBackendAuto;
 
   struct RenderData
   {
@@ -488,13 +494,25 @@ void HeightmapImageDetail::RenderData::clear()
 }
 
 
-HeightmapImage::HeightmapImage(ImageType type, unsigned pixels_per_voxel)
+HeightmapImage::HeightmapImage(ImageType type, unsigned pixels_per_voxel, Backend backend)
   : imp_(new HeightmapImageDetail)
 {
   PROFILE(HeightmapImageDetail);
   imp_->desired_type = imp_->generated_type = type;
   imp_->pixels_per_voxel = pixels_per_voxel;
-  imp_->render_data.init();
+  imp_->backend = backend;
+  if (backend != kBackendCpu)
+  {
+    // Fallback to CPU rendering when we fail to create an OpenGL context.
+    if (!imp_->render_data.init() && backend == kBackendAuto)
+    {
+      imp_->backend = kBackendCpu;
+    }
+    else
+    {
+      imp_->backend = kBackendOpenGL;
+    }
+  }
 }
 
 
@@ -504,6 +522,12 @@ HeightmapImage::~HeightmapImage()
 }
 
 
+HeightmapImage::Backend HeightmapImage::backend() const
+{
+  return imp_->backend;
+}
+
+
 HeightmapImage::ImageType HeightmapImage::desiredImageType()
 {
   return imp_->desired_type;
@@ -539,6 +563,12 @@ void HeightmapImage::setShowWindow(bool show_window)
   if (imp_->render_data.show_window != show_window)
   {
     imp_->render_data.show_window = show_window;
+    if (!imp_->render_data.window)
+    {
+      // No OpenGL context.
+      return;
+    }
+
     if (show_window)
     {
       glfwShowWindow(imp_->render_data.window);
@@ -621,6 +651,67 @@ bool HeightmapImage::generateBitmap(const HeightmapMesh &mesh, UpAxis up_axis)
 }
 
 
+bool HeightmapImage::generateBitmap(const HeightmapMeshTile *tiles, size_t tile_count, double resolution,
+                                    UpAxis up_axis)
+{
+  PROFILE(HeightmapImage_generateBitmap);
+  // Merge the tiles into a single vertex and index buffer.
+  size_t vertex_count = 0;
+  size_t index_count = 0;
+  for (size_t i = 0; i < tile_count; ++i)
+  {
+    vertex_count += tiles[i].vertices.size();
+    index_count += tiles[i].indices.size();
+  }
+
+  std::vector<glm::dvec3> vertices;
+  std::vector<glm::vec3> vertex_normals;
+  std::vector<unsigned> indices;
+  vertices.reserve(vertex_count);
+  vertex_normals.reserve(vertex_count);
+  indices.reserve(index_count);
+
+  glm::dvec3 min_ext(std::numeric_limits<double>::max());
+  glm::dvec3 max_ext(-std::numeric_limits<double>::max());
+  for (size_t i = 0; i < tile_count; ++i)
+  {
+    const HeightmapMeshTile &tile = tiles[i];
+    const unsigned index_offset = unsigned(vertices.size());
+    for (const glm::vec3 &vertex : tile.vertices)
+    {
+      vertices.emplace_back(tile.origin + glm::dvec3(vertex));
+      min_ext = glm::min(min_ext, vertices.back());
+      max_ext = glm::max(max_ext, vertices.back());
+    }
+    vertex_normals.insert(vertex_normals.end(), tile.vertex_normals.begin(), tile.vertex_normals.end());
+    for (const unsigned index : tile.indices)
+    {
+      indices.emplace_back(index + index_offset);
+    }
+  }
+
+  if (vertices.empty())
+  {
+    return false;
+  }
+
+  // Loose extents enclosing the generating voxels, tight along the up axis, to match HeightmapMesh::meshBoundingBox().
+  const int up_axis_index = (int(up_axis) >= 0) ? int(up_axis) : -int(up_axis) - 1;
+  for (int i = 0; i < 3; ++i)
+  {
+    if (i != up_axis_index)
+    {
+      min_ext[i] -= 0.5 * resolution;
+      max_ext[i] += 0.5 * resolution;
+    }
+  }
+
+  const glm::vec3 *colours_ptr = nullptr;
+  return renderHeightMesh(imp_->desired_type, Aabb(min_ext, max_ext), resolution, vertices.data(), vertices.size(),
+                          indices.data(), indices.size(), vertex_normals.data(), colours_ptr, up_axis);
+}
+
+
 template <typename NormalVec3, typename ColourVec>
 bool HeightmapImage::renderHeightMesh(ImageType image_type, const Aabb &spatial_extents, double voxel_resolution,
                                       const glm::dvec3 *vertices, size_t vertex_count, const unsigned *indices,
@@ -749,6 +840,75 @@ bool HeightmapImage::renderHeightMesh(ImageType image_type, const Aabb &spatial_
   max_ext_vertices[axes[0]] += float(render_width - target_width) / float(pixels_per_voxel) * float(voxel_resolution);
   max_ext_vertices[axes[1]] += float(render_height - target_height) / float(pixels_per_voxel) * float(voxel_resolution);
 
+  //----------------------------------------------------------------------------
+  // Camera setup
+  //----------------------------------------------------------------------------
+  const float near_clip = 0.0f;
+  const float camera_offset = 0.0f;
+  // Near and far clip planes require sufficient buffering to exceed the min/max extents range.
+  // So near is at 1.0f (to avoid some depth precision issues), far is near clip (1) + range + camera_offset (2)
+  const glm::mat4 projection_matrix =
+    glm::ortho(-0.5f * max_ext_vertices[axes[0]] - min_ext_vertices[axes[0]],
+               0.5f * max_ext_vertices[axes[0]] - min_ext_vertices[axes[0]],
+               -0.5f * max_ext_vertices[axes[1]] - min_ext_vertices[axes[1]],
+               0.5f * max_ext_vertices[axes[1]] - min_ext_vertices[axes[1]], near_clip,
+               near_clip + camera_offset + max_ext_vertices[axes[2]] - min_ext_vertices[axes[2]]);
+  // Look down from above.
+  glm::vec3 eye = 0.5f * glm::vec3(min_ext_vertices + max_ext_vertices);
+  glm::vec3 target = eye;
+  eye[axes[2]] = max_ext_vertices[axes[2]] + camera_offset;
+  target[axes[2]] = 0;
+  glm::vec3 view_up(0.0f);
+  view_up[axes[1]] = (int(up_axis) >= 0) ? 1.0f : -1.0f;
+  const glm::mat4 view_matrix = glm::lookAt(eye, target, view_up);
+
+  const glm::mat4 model_matrix = glm::mat4(1.0);
+  const glm::mat4 mvp_matrix = projection_matrix * view_matrix * model_matrix;
+
+  const bool output_render_texture = (colours != nullptr || image_type != kImageHeights);
+
+  imp_->image_info.image_width = render_width;
+  imp_->image_info.image_height = render_height;
+
+  imp_->image_info.image_extents =
+    Aabb(spatial_extents.minExtents(), spatial_extents.minExtents() + glm::dvec3(max_ext_vertices));
+  imp_->image_info.type = (colours) ? kImageVertexColours888 : image_type;
+
+  if (imp_->backend == kBackendCpu)
+  {
+    // Render without OpenGL.
+    RasterParams params;
+    params.width = render_width;
+    params.height = render_height;
+    // Select the format to match the OpenGL output texture.
+    params.format = RasterFormat::kDepth32f;
+    if (output_render_texture)
+    {
+      params.format = (image_type == kImageNormals && colours == nullptr) ? RasterFormat::kRgb32f : RasterFormat::kRgb8;
+    }
+    params.mvp = mvp_matrix;
+    params.model_view = view_matrix * model_matrix;
+    params.vertices = imp_->vertices.data();
+    params.normals = imp_->vertex_normals.data();
+    params.colours = (colours) ? imp_->vertex_colours.data() : nullptr;
+    params.vertex_count = vertex_count;
+    params.indices = indices;
+    params.index_count = index_count;
+    rasteriseMesh(params, imp_->image);
+
+    imp_->image_info.bpp = (params.format == RasterFormat::kRgb8) ? 3u :
+                           (params.format == RasterFormat::kRgb32f) ? unsigned(3 * sizeof(float)) :
+                                                                      unsigned(sizeof(float));
+    imp_->image_info.byte_count = imp_->image.size();
+    return true;
+  }
+
+  if (!imp_->render_data.window)
+  {
+    // No OpenGL context.
+    return false;
+  }
+
   //----------------------------------------------------------------------------
   // Rendering setup.
   //----------------------------------------------------------------------------
@@ -872,13 +1032,12 @@ bool HeightmapImage::renderHeightMesh(ImageType image_type, const Aabb &spatial_
     return false;
   }
 
-  const bool output_render_texture = (colours != nullptr || image_type != kImageHeights);
   GLuint output_texture_id = (output_render_texture) ? render_texture : depth_texture;
   AttachmentFormat output_texture_format = (output_render_texture) ? render_texture_format : depth_texture_format;
   GLenum output_format_type = (output_render_texture) ? GL_RGB : GL_DEPTH_COMPONENT;
 
   //----------------------------------------------------------------------------
-  // Camera setup
+  // Shader setup
   //----------------------------------------------------------------------------
   int mesh_program_id =
     (colours) ? imp_->render_data.mesh_colours_program_id : imp_->render_data.mesh_normals_program_id;
@@ -889,28 +1048,6 @@ bool HeightmapImage::renderHeightMesh(ImageType image_type, const Aabb &spatial_
   GLuint v_matrix_id = glGetUniformLocation(mesh_program_id, "V");
   GLuint m_matrix_id = glGetUniformLocation(mesh_program_id, "M");
 
-  const float near_clip = 0.0f;
-  const float camera_offset = 0.0f;
-  // Near and far clip planes require sufficient buffering to exceed the min/max extents range.
-  // So near is at 1.0f (to avoid some depth precision issues), far is near clip (1) + range + camera_offset (2)
-  const glm::mat4 projection_matrix =
-    glm::ortho(-0.5f * max_ext_vertices[axes[0]] - min_ext_vertices[axes[0]],
-               0.5f * max_ext_vertices[axes[0]] - min_ext_vertices[axes[0]],
-               -0.5f * max_ext_vertices[axes[1]] - min_ext_vertices[axes[1]],
-               0.5f * max_ext_vertices[axes[1]] - min_ext_vertices[axes[1]], near_clip,
-               near_clip + camera_offset + max_ext_vertices[axes[2]] - min_ext_vertices[axes[2]]);
-  // Look down from above.
-  glm::vec3 eye = 0.5f * glm::vec3(min_ext_vertices + max_ext_vertices);
-  glm::vec3 target = eye;
-  eye[axes[2]] = max_ext_vertices[axes[2]] + camera_offset;
-  target[axes[2]] = 0;
-  glm::vec3 view_up(0.0f);
-  view_up[axes[1]] = (int(up_axis) >= 0) ? 1.0f : -1.0f;
-  const glm::mat4 view_matrix = glm::lookAt(eye, target, view_up);
-
-  const glm::mat4 model_matrix = glm::mat4(1.0);
-  const glm::mat4 mvp_matrix = projection_matrix * view_matrix * model_matrix;
-
   // Send our transformation to the currently bound shader,
   // in the "mvp_matrix" uniform
   glUniformMatrix4fv(mvp_matrix_id, 1, GL_FALSE, &mvp_matrix[0][0]);
@@ -1028,13 +1165,6 @@ bool HeightmapImage::renderHeightMesh(ImageType image_type, const Aabb &spatial_
              glfwWindowShouldClose(imp_->render_data.window) == 0);
   }
 
-  imp_->image_info.image_width = render_width;
-  imp_->image_info.image_height = render_height;
-
-  imp_->image_info.image_extents =
-    Aabb(spatial_extents.minExtents(), spatial_extents.minExtents() + glm::dvec3(max_ext_vertices));
-  imp_->image_info.type = (colours) ? kImageVertexColours888 : image_type;
-
   // Read pixels:
   switch (output_texture_format)
   {
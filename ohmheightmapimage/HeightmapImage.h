@@ -21,11 +21,15 @@ namespace ohm
 struct Colour;
 class Heightmap;
 class HeightmapMesh;
+struct HeightmapMeshTile;
 
 struct HeightmapImageDetail;
 
 /// Experimental conversion of a @c Heightmap into an image by rendering to an OpenGL FGO.
 ///
+/// Rendering requires an OpenGL context, which needs a windowing system. Where that is unavailable, such as on a
+/// headless server, the image is generated using a CPU rasteriser instead - see @c Backend .
+///
 /// The resulting image may be either an RGB image where the RGB values map the local surface normals (like a
 /// normal map in rendering) or a grey scale depth value, relative to the min/max for the input data set.
 /// The RGB image may be provided either as a pure RGB uint8 format (1 byte per channel) using @c kImageNormals888
@@ -65,6 +69,17 @@ public:
     kImageVertexColours888
   };
 
+  /// Image rendering backends.
+  enum ohmheightmapimage_API Backend
+  {
+    /// Use OpenGL when an OpenGL context can be created, falling back to @c kBackendCpu otherwise.
+    kBackendAuto,
+    /// Render using OpenGL. Image generation fails when no OpenGL context can be created.
+    kBackendOpenGL,
+    /// Render using a CPU rasteriser. Requires no OpenGL context.
+    kBackendCpu
+  };
+
   /// Information about the generated bitmap.
   struct ohmheightmapimage_API BitmapInfo
   {
@@ -82,9 +97,18 @@ public:
     Aabb image_extents = Aabb(0.0);
   };
 
-  explicit HeightmapImage(ImageType type = kImageNormals, unsigned pixels_per_voxel = 1);
+  /// Constructor.
+  /// @param type The desired image type.
+  /// @param pixels_per_voxel Number of pixels per heightmap voxel.
+  /// @param backend The rendering backend. An OpenGL context is only created when not using @c kBackendCpu .
+  explicit HeightmapImage(ImageType type = kImageNormals, unsigned pixels_per_voxel = 1,
+                          Backend backend = kBackendAuto);
   ~HeightmapImage();
 
+  /// Query the rendering backend in use. This is never @c kBackendAuto , reporting the resolved backend instead.
+  /// @return The active backend.
+  Backend backend() const;
+
   ImageType desiredImageType();
   void setDesiredImageType(ImageType type);
 
@@ -155,6 +179,15 @@ public:
   /// @param up_axis Identifies the up axis.
   bool generateBitmap(const HeightmapMesh &mesh, UpAxis up_axis = UpAxis::kZ);
 
+  /// Generate a single bitmap image from multiple @c HeightmapMeshTile tiles - see @c HeightmapMesh::buildTiles() .
+  /// All tiles are rendered in one pass. Does not support @c kImageVertexColours888 image mode.
+  /// @param tiles The tiles to generate an image of.
+  /// @param tile_count The number of @p tiles .
+  /// @param resolution The heightmap voxel resolution - see @c HeightmapMesh::resolution() .
+  /// @param up_axis Identifies the up axis.
+  bool generateBitmap(const HeightmapMeshTile *tiles, size_t tile_count, double resolution,
+                      UpAxis up_axis = UpAxis::kZ);
+
 private:
   template <typename NormalVec3, typename ColourVec>
   bool renderHeightMesh(ImageType type, const Aabb &spatial_extents, double voxel_resolution,
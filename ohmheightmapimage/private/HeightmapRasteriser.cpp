@@ -0,0 +1,217 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "HeightmapRasteriser.h"
+
+#include <ohmutil/Profile.h>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace ohm
+{
+namespace
+{
+/// Number of image rows in each band.
+constexpr unsigned kBandHeight = 16u;
+
+/// A vertex transformed to window coordinates.
+struct WindowVertex
+{
+  /// Window coordinates. XY in pixels, Z is the [0, 1] depth.
+  glm::vec3 pos;
+  /// Output colour.
+  glm::vec3 colour;
+};
+
+/// Edge function for the edge @p a to @p b and point @p p . Positive when @p p is left of the edge.
+inline float edgeFunction(const glm::vec3 &a, const glm::vec3 &b, float px, float py)
+{
+  return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+/// Is the edge @p a to @p b of a counter clockwise triangle a top or left edge? Pixel centres exactly on such edges
+/// are included in the triangle, matching the OpenGL fill convention.
+inline bool isTopLeft(const glm::vec3 &a, const glm::vec3 &b)
+{
+  const float dx = b.x - a.x;
+  const float dy = b.y - a.y;
+  return dy < 0 || (dy == 0 && dx < 0);
+}
+
+/// Fill triangle @p tri within the rows [@p row_begin, @p row_end) .
+void fillTriangle(const std::array<const WindowVertex *, 3> &tri, unsigned row_begin, unsigned row_end,
+                  unsigned width, std::vector<float> &depth, std::vector<glm::vec3> &colour)
+{
+  const glm::vec3 &p0 = tri[0]->pos;
+  const glm::vec3 &p1 = tri[1]->pos;
+  const glm::vec3 &p2 = tri[2]->pos;
+  const float area = edgeFunction(p0, p1, p2.x, p2.y);
+
+  const float min_x = std::min(p0.x, std::min(p1.x, p2.x));
+  const float max_x = std::max(p0.x, std::max(p1.x, p2.x));
+  const float min_y = std::min(p0.y, std::min(p1.y, p2.y));
+  const float max_y = std::max(p0.y, std::max(p1.y, p2.y));
+
+  // Pixel centres covered by the bounds.
+  const int x_begin = std::max(0, int(std::ceil(min_x - 0.5f)));
+  const int x_end = std::min(int(width), int(std::floor(max_x - 0.5f)) + 1);
+  const int y_begin = std::max(int(row_begin), int(std::ceil(min_y - 0.5f)));
+  const int y_end = std::min(int(row_end), int(std::floor(max_y - 0.5f)) + 1);
+
+  const bool top_left0 = isTopLeft(p1, p2);
+  const bool top_left1 = isTopLeft(p2, p0);
+  const bool top_left2 = isTopLeft(p0, p1);
+
+  for (int y = y_begin; y < y_end; ++y)
+  {
+    const float py = float(y) + 0.5f;
+    for (int x = x_begin; x < x_end; ++x)
+    {
+      const float px = float(x) + 0.5f;
+      const float w0 = edgeFunction(p1, p2, px, py);
+      const float w1 = edgeFunction(p2, p0, px, py);
+      const float w2 = edgeFunction(p0, p1, px, py);
+
+      if ((w0 > 0 || (w0 == 0 && top_left0)) && (w1 > 0 || (w1 == 0 && top_left1)) &&
+          (w2 > 0 || (w2 == 0 && top_left2)))
+      {
+        const float l0 = w0 / area;
+        const float l1 = w1 / area;
+        const float l2 = w2 / area;
+        const float z = l0 * p0.z + l1 * p1.z + l2 * p2.z;
+        const size_t pixel = size_t(y) * width + size_t(x);
+        // Depth clipping and depth test.
+        if (z >= 0.0f && z <= 1.0f && z < depth[pixel])
+        {
+          depth[pixel] = z;
+          colour[pixel] = l0 * tri[0]->colour + l1 * tri[1]->colour + l2 * tri[2]->colour;
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+
+void rasteriseMesh(const RasterParams &params, std::vector<uint8_t> &image)
+{
+  PROFILE(rasteriseMesh);
+  const unsigned width = params.width;
+  const unsigned height = params.height;
+  const size_t pixel_count = size_t(width) * size_t(height);
+
+  // Transform to window coordinates.
+  std::vector<WindowVertex> window_vertices(params.vertex_count);
+  for (size_t i = 0; i < params.vertex_count; ++i)
+  {
+    const glm::vec4 clip = params.mvp * glm::vec4(params.vertices[i], 1.0f);
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    WindowVertex &vertex = window_vertices[i];
+    vertex.pos = glm::vec3(0.5f * (ndc.x + 1.0f) * float(width), 0.5f * (ndc.y + 1.0f) * float(height),
+                           0.5f * (ndc.z + 1.0f));
+    if (params.colours)
+    {
+      vertex.colour = params.colours[i];
+    }
+    else if (params.normals)
+    {
+      vertex.colour = 0.5f * (glm::vec3(params.model_view * glm::vec4(params.normals[i], 0.0f)) + glm::vec3(1.0f));
+    }
+    else
+    {
+      vertex.colour = glm::vec3(1.0f);
+    }
+  }
+
+  // Bin front facing triangles into bands.
+  const unsigned band_count = (height + kBandHeight - 1) / kBandHeight;
+  std::vector<std::vector<unsigned>> bands(band_count);
+  for (size_t i = 0; i + 2 < params.index_count; i += 3)
+  {
+    const glm::vec3 &p0 = window_vertices[params.indices[i + 0]].pos;
+    const glm::vec3 &p1 = window_vertices[params.indices[i + 1]].pos;
+    const glm::vec3 &p2 = window_vertices[params.indices[i + 2]].pos;
+    // Cull back faces and degenerate triangles. Front faces are counter clockwise.
+    if (!(edgeFunction(p0, p1, p2.x, p2.y) > 0))
+    {
+      continue;
+    }
+
+    const float min_y = std::min(p0.y, std::min(p1.y, p2.y));
+    const float max_y = std::max(p0.y, std::max(p1.y, p2.y));
+    const int row_first = std::max(0, int(std::ceil(min_y - 0.5f)));
+    const int row_last = std::min(int(height) - 1, int(std::floor(max_y - 0.5f)));
+    for (int band = row_first / int(kBandHeight); row_first <= row_last && band <= row_last / int(kBandHeight); ++band)
+    {
+      bands[band].emplace_back(unsigned(i));
+    }
+  }
+
+  std::vector<float> depth(pixel_count, 1.0f);
+  std::vector<glm::vec3> colour(pixel_count, glm::vec3(0.0f));
+
+  const auto fill_band = [&](unsigned band) {
+    const unsigned row_begin = band * kBandHeight;
+    const unsigned row_end = std::min(height, row_begin + kBandHeight);
+    for (const unsigned index : bands[band])
+    {
+      const std::array<const WindowVertex *, 3> tri = { &window_vertices[params.indices[index + 0]],
+                                                        &window_vertices[params.indices[index + 1]],
+                                                        &window_vertices[params.indices[index + 2]] };
+      fillTriangle(tri, row_begin, row_end, width, depth, colour);
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  tbb::parallel_for(tbb::blocked_range<unsigned>(0, band_count), [&](const tbb::blocked_range<unsigned> &range) {
+    for (unsigned band = range.begin(); band != range.end(); ++band)
+    {
+      fill_band(band);
+    }
+  });
+#else   // OHM_FEATURE_THREADS
+  for (unsigned band = 0; band < band_count; ++band)
+  {
+    fill_band(band);
+  }
+#endif  // OHM_FEATURE_THREADS
+
+  // Convert to the output format.
+  switch (params.format)
+  {
+  case RasterFormat::kRgb8:
+    image.resize(pixel_count * 3);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+      const glm::vec3 c = glm::clamp(colour[i], glm::vec3(0.0f), glm::vec3(1.0f));
+      image[i * 3 + 0] = uint8_t(std::lround(c.r * 255.0f));
+      image[i * 3 + 1] = uint8_t(std::lround(c.g * 255.0f));
+      image[i * 3 + 2] = uint8_t(std::lround(c.b * 255.0f));
+    }
+    break;
+  case RasterFormat::kRgb32f:
+    image.resize(pixel_count * sizeof(glm::vec3));
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Unexpected glm::vec3 padding");
+    std::memcpy(image.data(), colour.data(), image.size());
+    break;
+  case RasterFormat::kDepth32f:
+    image.resize(pixel_count * sizeof(float));
+    std::memcpy(image.data(), depth.data(), image.size());
+    break;
+  default:
+    image.clear();
+    break;
+  }
+}
+}  // namespace ohm
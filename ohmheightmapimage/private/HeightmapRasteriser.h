@@ -0,0 +1,72 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMHEIGHTMAPIMAGE_HEIGHTMAPRASTERISER_H
+#define OHMHEIGHTMAPIMAGE_HEIGHTMAPRASTERISER_H
+
+#include "OhmHeightmapImageConfig.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace ohm
+{
+/// Pixel formats supported by @c rasteriseMesh() .
+enum class RasterFormat
+{
+  /// RGB 3 bytes per pixel, uint8_t per channel.
+  kRgb8,
+  /// RGB 12 bytes per pixel, float32 per channel.
+  kRgb32f,
+  /// Mono 4 bytes per pixel, float32 depth values.
+  kDepth32f
+};
+
+/// Input and output parameters for @c rasteriseMesh() .
+struct RasterParams
+{
+  /// Image pixel width.
+  unsigned width = 0;
+  /// Image pixel height.
+  unsigned height = 0;
+  /// Output pixel format.
+  RasterFormat format = RasterFormat::kRgb8;
+  /// Model, view, projection matrix.
+  glm::mat4 mvp = glm::mat4(1.0f);
+  /// Model view matrix used to transform the vertex normals.
+  glm::mat4 model_view = glm::mat4(1.0f);
+  /// Vertices to render.
+  const glm::vec3 *vertices = nullptr;
+  /// Per vertex normals. Used when @c colours is null.
+  const glm::vec3 *normals = nullptr;
+  /// Optional per vertex colours. Used in preference to @c normals .
+  const glm::vec3 *colours = nullptr;
+  /// Number of @c vertices , @c normals and @c colours .
+  size_t vertex_count = 0;
+  /// Triangle index triples.
+  const unsigned *indices = nullptr;
+  /// Number of @c indices .
+  size_t index_count = 0;
+};
+
+/// A CPU implementation of the @c HeightmapImage OpenGL render, for use where no OpenGL context is available.
+///
+/// This matches the OpenGL pipeline used by @c HeightmapImage : vertices are transformed by the @c RasterParams::mvp
+/// matrix, back faces are culled, and fragments are depth tested (less) against a depth buffer cleared to 1. With
+/// @c RasterParams::colours the vertex colours are interpolated, otherwise the model view transformed normals are
+/// interpolated and mapped from [-1, 1] to [0, 1] colour channels. The @c RasterFormat::kDepth32f format instead
+/// writes the depth buffer values. Pixels are written bottom row first, as read from an OpenGL texture.
+///
+/// The image is split into horizontal bands, each filled using a scanline triangle fill over the triangles which
+/// overlap the band. Bands are filled in parallel when @c OHM_FEATURE_THREADS is enabled.
+///
+/// @param params Rasterisation parameters.
+/// @param[out] image Pixel output. Resized to fit the image.
+void rasteriseMesh(const RasterParams &params, std::vector<uint8_t> &image);
+}  // namespace ohm
+
+#endif  // OHMHEIGHTMAPIMAGE_HEIGHTMAPRASTERISER_H
@@ -8,6 +8,7 @@
 #include <ohm/Density.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/OccupancyType.h>
+#include <ohm/ParallelForEach.h>
 #include <ohm/Query.h>
 #include <ohm/VoxelData.h>
 
@@ -24,6 +25,9 @@
 #include <algorithm>
 #include <fstream>
 #include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace
 {
@@ -60,6 +64,7 @@ struct ExtractedVoxel
 {
   glm::dvec3 position = glm::dvec3(0);
   ohm::Colour colour = ohm::Colour(0);
+  ohm::Key key = ohm::Key::kNull;
 };
 
 enum SaveWithFlags
@@ -67,61 +72,385 @@ enum SaveWithFlags
   WithColour = (1 << 0)
 };
 
-uint64_t saveAnyCloud(const std::string &file_name, const ohm::OccupancyMap &map,
-                      std::function<bool(ExtractedVoxel &, const ohm::OccupancyMap::const_iterator &)> extract_voxel,
-                      unsigned with_flags, const ohmtools::ProgressCallback &prog)
+/// Voxel selection function for @c extractVoxels() . Sets the @c ExtractedVoxel::position for the voxel at the given
+/// key in the given chunk, returning true if the voxel is to be exported.
+///
+/// This is invoked concurrently with a copy of the function for each worker, so any @c Voxel objects must be captured
+/// by value (in a @c mutable lambda) and not shared between workers.
+using SelectVoxel = std::function<bool(ExtractedVoxel &, const ohm::Key &, const ohm::MapChunk &)>;
+
+/// Voxel colour function for @c extractVoxels() . Sets the @c ExtractedVoxel::colour for a selected voxel in the
+/// given chunk. This is always invoked on the calling thread, in voxel iteration order, so user colour selection
+/// functions need not be thread safe.
+using ColourVoxel = std::function<void(ExtractedVoxel &, const ohm::MapChunk &)>;
+
+/// Maximum number of regions to select voxels from before passing them on in @c extractVoxels() . Limits the memory
+/// overhead of buffering the selected voxels.
+const size_t kExtractRegionWindow = 256u;
+
+/// Number of points to encode before writing a block to a ply stream.
+const size_t kPlyWriteBatch = 65536u;
+
+/// Function invoked for each selected and coloured voxel of an @c ExtractOutput .
+using AddVoxel = std::function<void(const ExtractedVoxel &)>;
+
+/// One output of a voxel extraction. Several outputs may be extracted in a single pass over the map, each with its own
+/// selection, colouring and destination.
+struct ExtractOutput
 {
-  std::ofstream out(file_name, std::ios::binary);
+  /// Voxel selection function. Copied for each worker.
+  SelectVoxel select_voxel;
+  /// Optional colour function.
+  ColourVoxel colour_voxel;
+  /// Function to invoke for each selected voxel.
+  AddVoxel add_voxel;
+  /// Selected voxels buffer for each region of the current window. These are the worker output buffers, reused
+  /// between windows.
+  std::vector<std::vector<ExtractedVoxel>> region_voxels;
+  /// Number of voxels passed to @c add_voxel .
+  uint64_t voxel_count = 0;
 
-  if (!out.is_open())
+  ExtractOutput() = default;
+  ExtractOutput(SelectVoxel select_voxel, ColourVoxel colour_voxel, AddVoxel add_voxel)
+    : select_voxel(std::move(select_voxel))
+    , colour_voxel(std::move(colour_voxel))
+    , add_voxel(std::move(add_voxel))
+  {}
+};
+
+/// Select voxels from a @p window of regions in parallel for each of the @p outputs , then colour and add them on the
+/// calling thread in region order. This is the shared implementation of @c extractVoxels() and @c streamVoxels() .
+///
+/// The selection and colour functions are copied for the window and the copies are released before returning, so any
+/// @c Voxel objects they capture by value release the window chunks.
+///
+/// @param window The regions to extract from.
+/// @param progress_offset Number of regions processed before this window, for progress reporting.
+/// @param progress_target Total number of regions to be processed, for progress reporting.
+/// @param region_voxel_dimensions The map @c OccupancyMap::regionVoxelDimensions() .
+/// @param outputs The outputs to extract.
+/// @param prog Optional progress callback.
+/// @return The number of voxels extracted over all outputs.
+uint64_t extractWindow(const std::vector<const ohm::MapChunk *> &window, size_t progress_offset,
+                       size_t progress_target, const glm::ivec3 &region_voxel_dimensions,
+                       std::vector<ExtractOutput> &outputs, const ohmtools::ProgressCallback &prog)
+{
+  std::vector<ohm::WorkerLocal<SelectVoxel>> selectors;
+  std::vector<ColourVoxel> colour_voxels;
+  selectors.reserve(outputs.size());
+  colour_voxels.reserve(outputs.size());
+  for (ExtractOutput &output : outputs)
   {
-    return 0;
+    selectors.emplace_back(output.select_voxel);
+    colour_voxels.emplace_back(output.colour_voxel);
+    if (output.region_voxels.size() < window.size())
+    {
+      output.region_voxels.resize(window.size());
+    }
   }
 
-  ExtractedVoxel voxel{};
-  const size_t region_count = map.regionCount();
-  size_t processed_region_count = 0;
-  glm::i16vec3 last_region = (map.regionCount() > 0) ? map.begin().key().regionKey() : glm::i16vec3(0);
-
-  // Setup the Ply stream.
-  ohm::PlyPointStream ply = setupPlyStream((with_flags & WithColour) != 0);
-  ply.open(out);
+  ohm::parallelForEachRegion(window, [&selectors, &outputs, &region_voxel_dimensions](
+                                       const ohm::MapChunk &chunk, size_t region_index, unsigned worker_index) {
+    for (size_t i = 0; i < outputs.size(); ++i)
+    {
+      outputs[i].region_voxels[region_index].clear();
+    }
+    ohm::forEachVoxelInRegion(chunk, region_voxel_dimensions, [&](const ohm::Key &key) {
+      for (size_t i = 0; i < outputs.size(); ++i)
+      {
+        ExtractedVoxel voxel{};
+        if (selectors[i].local(worker_index)(voxel, key, chunk))
+        {
+          voxel.key = key;
+          outputs[i].region_voxels[region_index].emplace_back(voxel);
+        }
+      }
+    });
+  });
 
-  uint64_t point_count = 0;
-  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  uint64_t voxel_count = 0;
+  for (size_t i = 0; i < window.size(); ++i)
   {
-    // Progress update.
-    if (last_region != iter.key().regionKey())
+    for (size_t j = 0; j < outputs.size(); ++j)
     {
-      ++processed_region_count;
-      if (prog)
+      ExtractOutput &output = outputs[j];
+      for (ExtractedVoxel &voxel : output.region_voxels[i])
       {
-        prog(processed_region_count, region_count);
+        if (colour_voxels[j])
+        {
+          colour_voxels[j](voxel, *window[i]);
+        }
+        output.add_voxel(static_cast<const ExtractedVoxel &>(voxel));
       }
-      last_region = iter.key().regionKey();
+      output.voxel_count += output.region_voxels[i].size();
+      voxel_count += output.region_voxels[i].size();
     }
 
-    if (extract_voxel(voxel, iter))
+    if (prog)
     {
-      ply.setPointPosition(voxel.position);
-      if (with_flags & WithColour)
-      {
-        ply.setProperty(kPropertyRed, voxel.colour.r());
-        ply.setProperty(kPropertyGreen, voxel.colour.g());
-        ply.setProperty(kPropertyBlue, voxel.colour.b());
-      }
+      prog(progress_offset + i + 1, progress_target);
+    }
+  }
+
+  return voxel_count;
+}
+
+/// Extract voxels from @p map for each of the @p outputs in a single pass, calling the output @c add_voxel for each
+/// voxel passing its @c select_voxel in the same order as an @c OccupancyMap::iterator .
+///
+/// Voxels are selected in parallel using @c ohm::parallelForEachRegion() , then coloured and added on the calling
+/// thread in region order.
+///
+/// @param map The map to extract from.
+/// @param outputs The outputs to extract. The @c ExtractOutput::voxel_count values are accumulated.
+/// @param prog Optional progress callback.
+/// @return The number of voxels extracted over all outputs.
+uint64_t extractVoxels(const ohm::OccupancyMap &map, std::vector<ExtractOutput> &outputs,
+                       const ohmtools::ProgressCallback &prog)
+{
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
 
-      ply.writePoint();
-      ++point_count;
+  const glm::ivec3 region_voxel_dimensions = map.regionVoxelDimensions();
+  std::vector<const ohm::MapChunk *> window;
+
+  uint64_t voxel_count = 0;
+  for (size_t window_start = 0; window_start < chunks.size(); window_start += kExtractRegionWindow)
+  {
+    const size_t window_end = std::min(window_start + kExtractRegionWindow, chunks.size());
+    window.assign(chunks.begin() + window_start, chunks.begin() + window_end);
+    voxel_count += extractWindow(window, window_start, chunks.size(), region_voxel_dimensions, outputs, prog);
+  }
+
+  return voxel_count;
+}
+
+/// Single output overload of @c extractVoxels() .
+/// @param map The map to extract from.
+/// @param select_voxel Voxel selection function. Copied for each worker.
+/// @param colour_voxel Optional colour function.
+/// @param prog Optional progress callback.
+/// @param add_voxel Function to invoke for each selected voxel.
+/// @return The number of voxels extracted.
+uint64_t extractVoxels(const ohm::OccupancyMap &map, const SelectVoxel &select_voxel, const ColourVoxel &colour_voxel,
+                       const ohmtools::ProgressCallback &prog, const AddVoxel &add_voxel)
+{
+  std::vector<ExtractOutput> outputs;
+  outputs.emplace_back(select_voxel, colour_voxel, add_voxel);
+  return extractVoxels(map, outputs, prog);
+}
+
+/// A streaming variant of @c extractVoxels() for a map opened via @c ohm::openIndexed() . Regions are fetched from the
+/// map file @p region_window regions at a time, in file order, and evicted from the map once their voxels have been
+/// added. Only one window of regions is resident at a time, so the map file may be larger than the available memory.
+///
+/// Any @c Voxel objects used by the output functions must be captured by value in order to release the evicted
+/// chunks. See @c extractWindow() .
+///
+/// @param map The map to stream from. Regions paged in from the map file are removed from the map.
+/// @param region_window The number of regions to fetch at a time.
+/// @param outputs The outputs to extract. The @c ExtractOutput::voxel_count values are accumulated.
+/// @param prog Optional progress callback.
+/// @return The number of voxels extracted over all outputs.
+uint64_t streamVoxels(ohm::OccupancyMap &map, size_t region_window, std::vector<ExtractOutput> &outputs,
+                      const ohmtools::ProgressCallback &prog)
+{
+  std::vector<glm::i16vec3> region_keys;
+  map.enumerateIndexedRegions(region_keys);
+  region_window = std::max<size_t>(region_window, 1u);
+
+  const glm::ivec3 region_voxel_dimensions = map.regionVoxelDimensions();
+  std::vector<glm::i16vec3> window_keys;
+  std::vector<const ohm::MapChunk *> window;
+  std::vector<ohm::MapChunk *> evicted;
+
+  uint64_t voxel_count = 0;
+  for (size_t window_start = 0; window_start < region_keys.size(); window_start += region_window)
+  {
+    const size_t window_end = std::min(window_start + region_window, region_keys.size());
+    window_keys.assign(region_keys.begin() + window_start, region_keys.begin() + window_end);
+    window.clear();
+    ohm::parallelFetchRegions(map, window_keys, window);
+
+    voxel_count += extractWindow(window, window_start, region_keys.size(), region_voxel_dimensions, outputs, prog);
+
+    map.detachRegions(window_keys, evicted);
+    ohm::OccupancyMap::releaseRegions(evicted);
+  }
+
+  return voxel_count;
+}
+
+/// Calculate the key range covered by the regions of a map opened via @c ohm::openIndexed() , including regions not yet
+/// paged in. The range covers whole regions.
+/// @param map The map to calculate the range of.
+/// @return The key range. Invalid if the map is not an indexed map.
+ohm::KeyRange indexedKeyRange(const ohm::OccupancyMap &map)
+{
+  std::vector<glm::i16vec3> region_keys;
+  if (map.enumerateIndexedRegions(region_keys) == 0)
+  {
+    return ohm::KeyRange();
+  }
+
+  glm::i16vec3 min_region = region_keys.front();
+  glm::i16vec3 max_region = region_keys.front();
+  for (const auto &region_key : region_keys)
+  {
+    min_region = glm::min(min_region, region_key);
+    max_region = glm::max(max_region, region_key);
+  }
+
+  const glm::u8vec3 max_local = map.regionVoxelDimensions() - glm::u8vec3(1);
+  return ohm::KeyRange(ohm::Key(min_region, glm::u8vec3(0)), ohm::Key(max_region, max_local), map);
+}
+
+/// Voxel selection and colouring for one point cloud export.
+struct CloudSelect
+{
+  SelectVoxel select_voxel;  ///< Voxel selection function. Empty when the export is not supported by the map.
+  ColourVoxel colour_voxel;  ///< Optional colour function.
+  unsigned with_flags = 0;   ///< @c SaveWithFlags values.
+};
+
+/// Writes extracted voxels to a ply point cloud, encoding points into a binary buffer and writing in large blocks.
+class PlyCloudWriter
+{
+public:
+  /// Open the ply file.
+  /// @param file_name The ply file to write.
+  /// @param with_flags @c SaveWithFlags values.
+  /// @return True on success.
+  bool open(const std::string &file_name, unsigned with_flags)
+  {
+    out_.open(file_name, std::ios::binary);
+    if (!out_.is_open())
+    {
+      return false;
     }
+
+    with_flags_ = with_flags;
+    ply_ = std::make_unique<ohm::PlyPointStream>(setupPlyStream((with_flags & WithColour) != 0));
+    ply_->open(out_);
+    buffer_ = std::make_unique<ohm::PlyPointBuffer>(ply_->properties());
+    buffer_->reserve(kPlyWriteBatch);
+    red_index_ = buffer_->propertyIndex(kPropertyRed);
+    green_index_ = buffer_->propertyIndex(kPropertyGreen);
+    blue_index_ = buffer_->propertyIndex(kPropertyBlue);
+    return true;
   }
 
-  ply.close();
-  out.close();
+  /// Add a voxel to the cloud.
+  /// @param voxel The voxel to add.
+  void add(const ExtractedVoxel &voxel)
+  {
+    const size_t point_index = buffer_->addPoint();
+    buffer_->setPointPosition(point_index, voxel.position);
+    if (with_flags_ & WithColour)
+    {
+      buffer_->setProperty(point_index, red_index_, voxel.colour.r());
+      buffer_->setProperty(point_index, green_index_, voxel.colour.g());
+      buffer_->setProperty(point_index, blue_index_, voxel.colour.b());
+    }
+
+    if (buffer_->pointCount() >= kPlyWriteBatch)
+    {
+      ply_->writePoints(*buffer_);
+      buffer_->clear();
+    }
+  }
+
+  /// Flush buffered points and close the file.
+  void close()
+  {
+    ply_->writePoints(*buffer_);
+    ply_->close();
+    out_.close();
+  }
+
+private:
+  std::ofstream out_;
+  std::unique_ptr<ohm::PlyPointStream> ply_;
+  std::unique_ptr<ohm::PlyPointBuffer> buffer_;
+  unsigned with_flags_ = 0;
+  int red_index_ = -1;
+  int green_index_ = -1;
+  int blue_index_ = -1;
+};
+
+/// Save several point clouds from @p map in a single pass over the map. Exports with an empty
+/// @c CloudSelect::select_voxel or which cannot be opened for writing are skipped, and report a zero point count.
+/// @param file_names The ply file to save each export to.
+/// @param selects The voxel selection for each export.
+/// @param map The map to save.
+/// @param prog Optional progress callback.
+/// @param stream_map When set, the map voxels are streamed from this map using @c streamVoxels() . This must be the
+///   same as @p map .
+/// @param region_window The number of regions to fetch at a time when streaming.
+/// @param[out] point_counts Set to the number of points saved for each export.
+/// @return The total number of points saved.
+uint64_t saveAnyClouds(const std::vector<std::string> &file_names, const std::vector<CloudSelect> &selects,
+                       const ohm::OccupancyMap &map, const ohmtools::ProgressCallback &prog,
+                       ohm::OccupancyMap *stream_map, size_t region_window, std::vector<uint64_t> &point_counts)
+{
+  std::vector<std::unique_ptr<PlyCloudWriter>> writers(selects.size());
+  std::vector<ExtractOutput> outputs;
+  std::vector<size_t> output_exports;
+  for (size_t i = 0; i < selects.size(); ++i)
+  {
+    if (!selects[i].select_voxel)
+    {
+      continue;
+    }
+
+    writers[i] = std::make_unique<PlyCloudWriter>();
+    if (!writers[i]->open(file_names[i], selects[i].with_flags))
+    {
+      writers[i].reset();
+      continue;
+    }
+
+    PlyCloudWriter *writer = writers[i].get();
+    outputs.emplace_back(selects[i].select_voxel, selects[i].colour_voxel,
+                         [writer](const ExtractedVoxel &voxel) { writer->add(voxel); });
+    output_exports.emplace_back(i);
+  }
+
+  point_counts.assign(selects.size(), 0u);
+  if (outputs.empty())
+  {
+    return 0;
+  }
+
+  const uint64_t point_count =
+    (stream_map) ? streamVoxels(*stream_map, region_window, outputs, prog) : extractVoxels(map, outputs, prog);
+
+  for (size_t i = 0; i < outputs.size(); ++i)
+  {
+    writers[output_exports[i]]->close();
+    point_counts[output_exports[i]] = outputs[i].voxel_count;
+  }
 
   return point_count;
 }
 
+/// Save the voxels selected by @p select to a ply point cloud.
+/// @param file_name The ply file to save to.
+/// @param map The map to save.
+/// @param select Voxel selection and colouring - see @c extractVoxels() .
+/// @param prog Optional progress callback.
+/// @param stream_map When set, the map voxels are streamed from this map using @c streamVoxels() . This must be the
+///   same as @p map .
+/// @param region_window The number of regions to fetch at a time when streaming.
+/// @return The number of points saved.
+uint64_t saveAnyCloud(const std::string &file_name, const ohm::OccupancyMap &map, const CloudSelect &select,
+                      const ohmtools::ProgressCallback &prog, ohm::OccupancyMap *stream_map = nullptr,
+                      size_t region_window = kExtractRegionWindow)
+{
+  std::vector<uint64_t> point_counts;
+  return saveAnyClouds({ file_name }, { select }, map, prog, stream_map, region_window, point_counts);
+}
+
 void addVoxel(ohm::PlyMesh &ply, const glm::dvec3 &position, double resolution, const ohm::Colour &colour)
 {
   const std::array<glm::dvec3, 8> vertices = {
@@ -135,7 +464,9 @@ void addVoxel(ohm::PlyMesh &ply, const glm::dvec3 &position, double resolution,
     position + glm::dvec3(-0.5 * resolution, 0.5 * resolution, 0.5 * resolution)
   };
 
-  const std::array<ohm::Colour, 8> colours = { colour, colour, colour, colour, colour, colour, colour, colour };
+  // One colour per triangle, which also covers the vertex colours.
+  std::array<ohm::Colour, 6 * 2> colours;  // NOLINT(readability-magic-numbers)
+  colours.fill(colour);
 
   const unsigned base_index = ply.addVertices(vertices.data(), unsigned(vertices.size()), colours.data());
 
@@ -152,13 +483,12 @@ void addVoxel(ohm::PlyMesh &ply, const glm::dvec3 &position, double resolution,
   {
     index += base_index;
   }
-  ply.addTriangles(indices.data(), 12, colours.data());
+  ply.addTriangles(indices.data(), unsigned(colours.size()), colours.data());
 }  // namespace ohmtools
 
 
-uint64_t saveAnyVoxels(const std::string &file_name, const ohm::OccupancyMap &map,
-                       std::function<bool(ExtractedVoxel &, const ohm::OccupancyMap::const_iterator &)> extract_voxel,
-                       unsigned with_flags, const ohmtools::ProgressCallback &prog)
+uint64_t saveAnyVoxels(const std::string &file_name, const ohm::OccupancyMap &map, const SelectVoxel &select_voxel,
+                       const ColourVoxel &colour_voxel, unsigned with_flags, const ohmtools::ProgressCallback &prog)
 {
   std::ofstream out(file_name, std::ios::binary);
 
@@ -170,33 +500,12 @@ uint64_t saveAnyVoxels(const std::string &file_name, const ohm::OccupancyMap &ma
   // Ply voxel mesh.
   ohm::PlyMesh ply;
 
-  ExtractedVoxel voxel{};
   const double resolution = map.resolution();
-  const size_t region_count = map.regionCount();
-  size_t processed_region_count = 0;
-  glm::i16vec3 last_region = (map.regionCount() > 0) ? map.begin().key().regionKey() : glm::i16vec3(0);
-
-  uint64_t voxel_count = 0;
-  for (auto iter = map.begin(); iter != map.end(); ++iter)
-  {
-    // Progress update.
-    if (last_region != iter.key().regionKey())
-    {
-      ++processed_region_count;
-      if (prog)
-      {
-        prog(processed_region_count, region_count);
-      }
-      last_region = iter.key().regionKey();
-    }
-
-    if (extract_voxel(voxel, iter))
-    {
-      const ohm::Colour c = (with_flags & WithColour) ? voxel.colour : ohm::Colour(255, 255, 255);
-      addVoxel(ply, voxel.position, resolution, c);
-      ++voxel_count;
-    }
-  }
+  const auto add_voxel = [&ply, resolution, with_flags](const ExtractedVoxel &voxel) {
+    const ohm::Colour c = (with_flags & WithColour) ? voxel.colour : ohm::Colour(255, 255, 255);
+    addVoxel(ply, voxel.position, resolution, c);
+  };
+  uint64_t voxel_count = extractVoxels(map, select_voxel, colour_voxel, prog, add_voxel);
 
   if (!ply.save(out, true))
   {
@@ -450,94 +759,179 @@ ohm::Colour ColourByHeightmapClearance::select(const ohm::Voxel<const float> &oc
 }
 
 
-uint64_t saveCloud(const std::string &file_name, const ohm::OccupancyMap &map, const SaveCloudOptions &opt,
-                   const ProgressCallback &prog)
+namespace
+{
+/// Build the voxel selection for @c saveCloud() and @c streamCloud() .
+/// @param map The map to save.
+/// @param opt Export controls.
+/// @param streaming True when the map regions will be streamed from an indexed map file.
+/// @return The voxel selection.
+CloudSelect occupancyCloudSelect(const ohm::OccupancyMap &map, const SaveCloudOptions &opt, bool streaming)
 {
+  CloudSelect select;
+
   // Work out if we need colour.
-  unsigned with_flags = 0;
   auto colour_select = opt.colour_select;
-  std::unique_ptr<ColourByHeight> colour_by_height;
   if (!colour_select && opt.allow_default_colour_selection)
   {
-    colour_by_height = std::make_unique<ColourByHeight>(map);
-    colour_select = [&colour_by_height](const ohm::Voxel<const float> &occupancy) {
+    // Streamed maps start with no regions resident, so the extents come from the file index.
+    const auto colour_by_height = (streaming) ? std::make_shared<ColourByHeight>(indexedKeyRange(map)) :
+                                                std::make_shared<ColourByHeight>(map);
+    colour_select = [colour_by_height](const ohm::Voxel<const float> &occupancy) {
       return colour_by_height->select(occupancy);
     };
   }
 
-  if (colour_select)
-  {
-    with_flags |= WithColour;
-  }
-
   ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
   auto mean = (opt.ignore_voxel_mean) ? ohm::Voxel<const ohm::VoxelMean>() :
                                         ohm::Voxel<const ohm::VoxelMean>(&map, map.layout().meanLayer());
 
-  const auto extract_voxel = [&map, &opt, &occupancy, &mean, colour_select](
-                               ExtractedVoxel &voxel, const ohm::OccupancyMap::const_iterator &iter) -> bool {
-    ohm::setVoxelKey(iter, occupancy, mean);
-    if (isOccupied(occupancy) || opt.export_free && isFree(occupancy))
+  // Copied for each worker, so the Voxel objects are captured by value.
+  const bool export_free = opt.export_free;
+  select.select_voxel = [&map, export_free, occupancy, mean](ExtractedVoxel &voxel, const ohm::Key &key,
+                                                             const ohm::MapChunk &chunk) mutable -> bool {
+    occupancy.setKey(key, &chunk);
+    mean.setKey(key, &chunk);
+    if (isOccupied(occupancy) || export_free && isFree(occupancy))
     {
-      voxel.position = (mean.isLayerValid()) ? positionSafe(mean) : map.voxelCentreGlobal(*iter);
-      if (colour_select)
-      {
-        voxel.colour = colour_select(occupancy);
-      }
+      voxel.position = (mean.isLayerValid()) ? positionSafe(mean) : map.voxelCentreGlobal(key);
       return true;
     }
     return false;
   };
 
-  return ::saveAnyCloud(file_name, map, extract_voxel, with_flags, prog);
+  if (colour_select)
+  {
+    select.with_flags |= WithColour;
+    select.colour_voxel = [occupancy, colour_select](ExtractedVoxel &voxel, const ohm::MapChunk &chunk) mutable {
+      occupancy.setKey(voxel.key, &chunk);
+      voxel.colour = colour_select(occupancy);
+    };
+  }
+
+  return select;
 }
 
 
-uint64_t saveDensityCloud(const std::string &file_name, const ohm::OccupancyMap &map,
-                          const SaveDensityCloudOptions &opt, const ProgressCallback &prog)
+/// Build the voxel selection for @c saveDensityCloud() and @c streamDensityCloud() .
+/// @param map The map to save.
+/// @param opt Export controls.
+/// @param streaming True when the map regions will be streamed from an indexed map file.
+/// @return The voxel selection. The selection function is empty when the map lacks the traversal or voxel mean layer.
+CloudSelect densityCloudSelect(const ohm::OccupancyMap &map, const SaveDensityCloudOptions &opt, bool streaming)
 {
+  CloudSelect select;
   ohm::Voxel<const float> traversal(&map, map.layout().traversalLayer());
   ohm::Voxel<const ohm::VoxelMean> mean(&map, map.layout().meanLayer());
-  unsigned with_flags = 0;
 
   if (!traversal.isLayerValid() || !mean.isLayerValid())
   {
-    return 0;
+    return select;
   }
 
   // Work out if we need colour.
   auto colour_select = opt.colour_select;
-  std::unique_ptr<ColourByHeight> colour_by_height;
   if (!colour_select && opt.allow_default_colour_selection)
   {
-    colour_by_height = std::make_unique<ColourByHeight>(map);
-    colour_select = [&colour_by_height](const ohm::Voxel<const float> &traversal) {
+    const auto colour_by_height = (streaming) ? std::make_shared<ColourByHeight>(indexedKeyRange(map)) :
+                                                std::make_shared<ColourByHeight>(map);
+    colour_select = [colour_by_height](const ohm::Voxel<const float> &traversal) {
       return colour_by_height->select(traversal);
     };
   }
 
-  if (colour_select)
-  {
-    with_flags |= WithColour;
-  }
-
-  const auto extract_voxel = [&map, &opt, &traversal, &mean, colour_select](
-                               ExtractedVoxel &voxel, const ohm::OccupancyMap::const_iterator &iter) -> bool {
+  // Copied for each worker, so the Voxel objects are captured by value.
+  const float density_threshold = opt.density_threshold;
+  const bool ignore_voxel_mean = opt.ignore_voxel_mean;
+  select.select_voxel = [&map, density_threshold, ignore_voxel_mean, traversal, mean](
+                          ExtractedVoxel &voxel, const ohm::Key &key, const ohm::MapChunk &chunk) mutable -> bool {
+    traversal.setKey(key, &chunk);
+    mean.setKey(key, &chunk);
     const float density = voxelDensity(traversal, mean);
-    if (density >= opt.density_threshold)
+    if (density >= density_threshold)
     {
-      voxel.position = (mean.isLayerValid()) ? positionSafe(mean) : map.voxelCentreGlobal(*iter);
-      voxel.position = (!opt.ignore_voxel_mean) ? positionSafe(mean) : map.voxelCentreGlobal(*iter);
-      if (colour_select)
-      {
-        voxel.colour = colour_select(traversal);
-      }
+      voxel.position = (!ignore_voxel_mean) ? positionSafe(mean) : map.voxelCentreGlobal(key);
       return true;
     }
     return false;
   };
 
-  return ::saveAnyCloud(file_name, map, extract_voxel, with_flags, prog);
+  if (colour_select)
+  {
+    select.with_flags |= WithColour;
+    select.colour_voxel = [traversal, colour_select](ExtractedVoxel &voxel, const ohm::MapChunk &chunk) mutable {
+      traversal.setKey(voxel.key, &chunk);
+      voxel.colour = colour_select(traversal);
+    };
+  }
+
+  return select;
+}
+
+
+/// Shared implementation of @c saveClouds() and @c streamClouds() . Streams from @p stream_map when set.
+uint64_t saveCloudExports(std::vector<CloudExport> &exports, const ohm::OccupancyMap &map,
+                          const ProgressCallback &prog, ohm::OccupancyMap *stream_map)
+{
+  std::vector<std::string> file_names;
+  std::vector<CloudSelect> selects;
+  for (const CloudExport &cloud : exports)
+  {
+    file_names.emplace_back(cloud.file_name);
+    selects.emplace_back((cloud.type == CloudExportType::kDensity) ?
+                           densityCloudSelect(map, cloud.options, stream_map != nullptr) :
+                           occupancyCloudSelect(map, cloud.options, stream_map != nullptr));
+  }
+
+  const size_t region_window = (!exports.empty()) ? exports.front().options.region_window : kExtractRegionWindow;
+  std::vector<uint64_t> point_counts;
+  const uint64_t point_count = ::saveAnyClouds(file_names, selects, map, prog, stream_map, region_window, point_counts);
+  for (size_t i = 0; i < exports.size(); ++i)
+  {
+    exports[i].point_count = point_counts[i];
+  }
+  return point_count;
+}
+}  // namespace
+
+
+uint64_t saveCloud(const std::string &file_name, const ohm::OccupancyMap &map, const SaveCloudOptions &opt,
+                   const ProgressCallback &prog)
+{
+  return ::saveAnyCloud(file_name, map, occupancyCloudSelect(map, opt, false), prog);
+}
+
+
+uint64_t streamCloud(const std::string &file_name, ohm::OccupancyMap &map, const SaveCloudOptions &opt,
+                     const ProgressCallback &prog)
+{
+  return ::saveAnyCloud(file_name, map, occupancyCloudSelect(map, opt, true), prog, &map, opt.region_window);
+}
+
+
+uint64_t saveDensityCloud(const std::string &file_name, const ohm::OccupancyMap &map,
+                          const SaveDensityCloudOptions &opt, const ProgressCallback &prog)
+{
+  return ::saveAnyCloud(file_name, map, densityCloudSelect(map, opt, false), prog);
+}
+
+
+uint64_t streamDensityCloud(const std::string &file_name, ohm::OccupancyMap &map, const SaveDensityCloudOptions &opt,
+                            const ProgressCallback &prog)
+{
+  return ::saveAnyCloud(file_name, map, densityCloudSelect(map, opt, true), prog, &map, opt.region_window);
+}
+
+
+uint64_t saveClouds(std::vector<CloudExport> &exports, const ohm::OccupancyMap &map, const ProgressCallback &prog)
+{
+  return saveCloudExports(exports, map, prog, nullptr);
+}
+
+
+uint64_t streamClouds(std::vector<CloudExport> &exports, ohm::OccupancyMap &map, const ProgressCallback &prog)
+{
+  return saveCloudExports(exports, map, prog, &map);
 }
 
 
@@ -566,22 +960,29 @@ uint64_t ohmtools_API saveVoxels(const std::string &file_name, const ohm::Occupa
   auto mean = (opt.ignore_voxel_mean) ? ohm::Voxel<const ohm::VoxelMean>() :
                                         ohm::Voxel<const ohm::VoxelMean>(&map, map.layout().meanLayer());
 
-  const auto extract_voxel = [&map, &opt, &occupancy, &mean, colour_select](
-                               ExtractedVoxel &voxel, const ohm::OccupancyMap::const_iterator &iter) -> bool {
-    ohm::setVoxelKey(iter, occupancy, mean);
+  // Copied for each worker, so the Voxel objects are captured by value.
+  const SelectVoxel select_voxel = [&map, &opt, occupancy, mean](ExtractedVoxel &voxel, const ohm::Key &key,
+                                                                 const ohm::MapChunk &chunk) mutable -> bool {
+    occupancy.setKey(key, &chunk);
+    mean.setKey(key, &chunk);
     if (isOccupied(occupancy) || opt.export_free && isFree(occupancy))
     {
-      voxel.position = (mean.isLayerValid()) ? positionSafe(mean) : map.voxelCentreGlobal(*iter);
-      if (colour_select)
-      {
-        voxel.colour = colour_select(occupancy);
-      }
+      voxel.position = (mean.isLayerValid()) ? positionSafe(mean) : map.voxelCentreGlobal(key);
       return true;
     }
     return false;
   };
 
-  return ::saveAnyVoxels(file_name, map, extract_voxel, with_flags, prog);
+  ColourVoxel colour_voxel;
+  if (colour_select)
+  {
+    colour_voxel = [&occupancy, &colour_select](ExtractedVoxel &voxel, const ohm::MapChunk &chunk) {
+      occupancy.setKey(voxel.key, &chunk);
+      voxel.colour = colour_select(occupancy);
+    };
+  }
+
+  return ::saveAnyVoxels(file_name, map, select_voxel, colour_voxel, with_flags, prog);
 }
 
 
@@ -613,23 +1014,30 @@ uint64_t saveDensityVoxels(const std::string &file_name, const ohm::OccupancyMap
     with_flags |= WithColour;
   }
 
-  const auto extract_voxel = [&map, &opt, &traversal, &mean, colour_select](
-                               ExtractedVoxel &voxel, const ohm::OccupancyMap::const_iterator &iter) -> bool {
+  // Copied for each worker, so the Voxel objects are captured by value.
+  const SelectVoxel select_voxel = [&map, &opt, traversal, mean](ExtractedVoxel &voxel, const ohm::Key &key,
+                                                                 const ohm::MapChunk &chunk) mutable -> bool {
+    traversal.setKey(key, &chunk);
+    mean.setKey(key, &chunk);
     const float density = voxelDensity(traversal, mean);
     if (density >= opt.density_threshold)
     {
-      voxel.position = (mean.isLayerValid()) ? positionSafe(mean) : map.voxelCentreGlobal(*iter);
-      voxel.position = (!opt.ignore_voxel_mean) ? positionSafe(mean) : map.voxelCentreGlobal(*iter);
-      if (colour_select)
-      {
-        voxel.colour = colour_select(traversal);
-      }
+      voxel.position = (!opt.ignore_voxel_mean) ? positionSafe(mean) : map.voxelCentreGlobal(key);
       return true;
     }
     return false;
   };
 
-  return ::saveAnyVoxels(file_name, map, extract_voxel, with_flags, prog);
+  ColourVoxel colour_voxel;
+  if (colour_select)
+  {
+    colour_voxel = [&traversal, &colour_select](ExtractedVoxel &voxel, const ohm::MapChunk &chunk) {
+      traversal.setKey(voxel.key, &chunk);
+      voxel.colour = colour_select(traversal);
+    };
+  }
+
+  return ::saveAnyVoxels(file_name, map, select_voxel, colour_voxel, with_flags, prog);
 }
 
 
@@ -880,16 +1288,6 @@ size_t saveClearanceCloud(const std::string &file_name, const ohm::OccupancyMap
                           const glm::dvec3 &max_extents, float colour_range, int export_type,
                           const ProgressCallback &prog)
 {
-  const size_t region_count = map.regionCount();
-  size_t processed_region_count = 0;
-  glm::dvec3 v;
-  glm::i16vec3 last_region = map.begin().key().regionKey();
-  ohm::PlyMesh ply;
-  size_t point_count = 0;
-
-  glm::i16vec3 min_region = map.regionKey(min_extents);
-  glm::i16vec3 max_region = map.regionKey(max_extents);
-
   ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
   ohm::Voxel<const float> clearance(&map, map.layout().clearanceLayer());
 
@@ -899,47 +1297,50 @@ size_t saveClearanceCloud(const std::string &file_name, const ohm::OccupancyMap
     return 0;
   }
 
+  const glm::i16vec3 min_region = map.regionKey(min_extents);
+  const glm::i16vec3 max_region = map.regionKey(max_extents);
   const float colour_scale = colour_range;
-  const auto map_end_iter = map.end();
-  for (auto iter = map.begin(); iter != map_end_iter; ++iter)
-  {
-    clearance.setKey(occupancy.setKey(*iter));
-    if (last_region != iter.key().regionKey())
+
+  // Copied for each worker, so the Voxel objects are captured by value. The colour depends only on the clearance
+  // value, so it is also resolved here.
+  const SelectVoxel select_voxel = [&map, min_region, max_region, colour_range, colour_scale, export_type, occupancy,
+                                    clearance](ExtractedVoxel &voxel, const ohm::Key &key,
+                                               const ohm::MapChunk &chunk) mutable -> bool {
+    // Ensure the voxel is in a region we have calculated data for.
+    const glm::i16vec3 region = chunk.region.coord;
+    if (glm::any(glm::lessThan(region, min_region)) || glm::any(glm::greaterThan(region, max_region)))
     {
-      ++processed_region_count;
-      if (prog)
-      {
-        prog(processed_region_count, region_count);
-      }
-      last_region = iter.key().regionKey();
+      return false;
     }
 
-    // Ensure the voxel is in a region we have calculated data for.
-    if (min_region.x <= last_region.x && last_region.x <= max_region.x &&  //
-        min_region.y <= last_region.y && last_region.y <= max_region.y &&  //
-        min_region.z <= last_region.z && last_region.z <= max_region.z)
+    occupancy.setKey(key, &chunk);
+    clearance.setKey(key, &chunk);
+    const bool export_match = !occupancy.isNull() && occupancyType(occupancy) >= export_type;
+    if (export_match)
     {
-      const bool export_match = !occupancy.isNull() && occupancyType(occupancy) >= export_type;
-      if (export_match)
+      float range_value;
+      assert(clearance.isValid());  // More for clang-tidy. We've already checked the layer validity.
+      clearance.read(&range_value);
+      if (range_value < 0)
       {
-        float range_value;
-        assert(clearance.isValid());  // More for clang-tidy. We've already checked the layer validity.
-        clearance.read(&range_value);
-        if (range_value < 0)
-        {
-          range_value = colour_range;
-        }
-        if (range_value >= 0)
-        {
-          uint8_t c =
-            uint8_t(std::numeric_limits<uint8_t>::max() * std::max(0.0f, (colour_scale - range_value) / colour_scale));
-          v = map.voxelCentreLocal(*iter);
-          ply.addVertex(v, ohm::Colour(c, std::numeric_limits<uint8_t>::max() / 2, 0));
-          ++point_count;
-        }
+        range_value = colour_range;
+      }
+      if (range_value >= 0)
+      {
+        const auto c =
+          uint8_t(std::numeric_limits<uint8_t>::max() * std::max(0.0f, (colour_scale - range_value) / colour_scale));
+        voxel.position = map.voxelCentreLocal(key);
+        voxel.colour = ohm::Colour(c, std::numeric_limits<uint8_t>::max() / 2, 0);
+        return true;
       }
     }
-  }
+    return false;
+  };
+
+  ohm::PlyMesh ply;
+  const size_t point_count =
+    extractVoxels(map, select_voxel, ColourVoxel(), prog,
+                  [&ply](const ExtractedVoxel &voxel) { ply.addVertex(voxel.position, voxel.colour); });
 
   ply.save(file_name, true);
 
@@ -966,24 +1367,30 @@ size_t saveTsdfCloud(const std::string &file_name, const ohm::OccupancyMap &map,
     return 0;
   }
 
-  const auto extract_voxel = [&map, surface_distance, &tsdf_voxel, colour_select](
-                               ExtractedVoxel &voxel, const ohm::OccupancyMap::const_iterator &iter) -> bool {
-    ohm::setVoxelKey(iter, tsdf_voxel);
+  // Copied for each worker, so the Voxel objects are captured by value.
+  const SelectVoxel select_voxel = [&map, surface_distance, tsdf_voxel](ExtractedVoxel &voxel, const ohm::Key &key,
+                                                                        const ohm::MapChunk &chunk) mutable -> bool {
+    tsdf_voxel.setKey(key, &chunk);
     const auto tsdf = tsdf_voxel.data();
     const bool export_match = tsdf.weight > 0 && std::abs(tsdf.distance) < surface_distance;
     if (export_match)
     {
-      voxel.position = map.voxelCentreLocal(*iter);
-      if (colour_select)
-      {
-        voxel.colour = colour_select(tsdf_voxel);
-      }
+      voxel.position = map.voxelCentreLocal(key);
       return true;
     }
     return false;
   };
 
-  return ::saveAnyCloud(file_name, map, extract_voxel, with_flags, prog);
+  ColourVoxel colour_voxel;
+  if (colour_select)
+  {
+    colour_voxel = [&tsdf_voxel, &colour_select](ExtractedVoxel &voxel, const ohm::MapChunk &chunk) {
+      tsdf_voxel.setKey(voxel.key, &chunk);
+      voxel.colour = colour_select(tsdf_voxel);
+    };
+  }
+
+  return ::saveAnyCloud(file_name, map, CloudSelect{ select_voxel, colour_voxel, with_flags }, prog);
 }
 
 
@@ -1005,23 +1412,29 @@ size_t saveTsdfVoxels(const std::string &file_name, const ohm::OccupancyMap &map
     return 0;
   }
 
-  const auto extract_voxel = [&map, surface_distance, &tsdf_voxel, colour_select](
-                               ExtractedVoxel &voxel, const ohm::OccupancyMap::const_iterator &iter) -> bool {
-    ohm::setVoxelKey(iter, tsdf_voxel);
+  // Copied for each worker, so the Voxel objects are captured by value.
+  const SelectVoxel select_voxel = [&map, surface_distance, tsdf_voxel](ExtractedVoxel &voxel, const ohm::Key &key,
+                                                                        const ohm::MapChunk &chunk) mutable -> bool {
+    tsdf_voxel.setKey(key, &chunk);
     const auto tsdf = tsdf_voxel.data();
     const bool export_match = tsdf.weight > 0 && std::abs(tsdf.distance) < surface_distance;
     if (export_match)
     {
-      voxel.position = map.voxelCentreLocal(*iter);
-      if (colour_select)
-      {
-        voxel.colour = colour_select(tsdf_voxel);
-      }
+      voxel.position = map.voxelCentreLocal(key);
       return true;
     }
     return false;
   };
 
-  return ::saveAnyVoxels(file_name, map, extract_voxel, with_flags, prog);
+  ColourVoxel colour_voxel;
+  if (colour_select)
+  {
+    colour_voxel = [&tsdf_voxel, &colour_select](ExtractedVoxel &voxel, const ohm::MapChunk &chunk) {
+      tsdf_voxel.setKey(voxel.key, &chunk);
+      voxel.colour = colour_select(tsdf_voxel);
+    };
+  }
+
+  return ::saveAnyVoxels(file_name, map, select_voxel, colour_voxel, with_flags, prog);
 }
 }  // namespace ohmtools
@@ -19,6 +19,7 @@
 #include <array>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace ohm
 {
@@ -54,6 +55,8 @@ struct ohmtools_API SaveCloudOptions
   bool export_free = false;
   /// Ignore voxel mean forcing voxel centres for positions?
   bool ignore_voxel_mean = false;
+  /// Number of regions to keep resident at a time when streaming a map - see @c streamCloud() .
+  size_t region_window = 256;
 };
 
 /// Options for saving a density cloud.
@@ -63,6 +66,27 @@ struct SaveDensityCloudOptions : SaveCloudOptions
   float density_threshold = 0;
 };
 
+/// Point cloud types for @c saveClouds() .
+enum class CloudExportType : int
+{
+  kOccupancy,  ///< As for @c saveCloud() .
+  kDensity     ///< As for @c saveDensityCloud() .
+};
+
+/// Describes one output of @c saveClouds() .
+struct ohmtools_API CloudExport
+{
+  /// File to save to. Please add the .ply extension.
+  std::string file_name;
+  /// The cloud type to save.
+  CloudExportType type = CloudExportType::kOccupancy;
+  /// Export controls. The @c density_threshold is only used for @c CloudExportType::kDensity . The
+  /// @c region_window of the first export sets the window for @c streamClouds() .
+  SaveDensityCloudOptions options;
+  /// Set to the number of points saved.
+  uint64_t point_count = 0;
+};
+
 /// Specialised options for saving heightmap clouds. Supports construction from a @c SaveCloudOptions setting default
 /// values for heightmap extended parameters.
 struct ohmtools_API SaveHeightmapCloudOptions : SaveCloudOptions
@@ -343,6 +367,58 @@ uint64_t ohmtools_API saveDensityCloud(const std::string &file_name, const ohm::
                                        const SaveDensityCloudOptions &opt = SaveDensityCloudOptions(),
                                        const ProgressCallback &prog = ProgressCallback());
 
+/// A streaming variant of @c saveCloud() for a map opened via @c ohm::openIndexed() , supporting maps larger than the
+/// available memory.
+///
+/// Regions are paged in from the map file @c SaveCloudOptions::region_window regions at a time, in parallel, and the
+/// voxels of each window are selected in parallel and written before the window regions are removed from the map. The
+/// map is left with none of the regions stored in the file resident. The default colour selection colours by height
+/// across the region extents recorded in the file index.
+///
+/// The map should be opened with only the required layers loaded eagerly - occupancy and optionally voxel mean - to
+/// minimise the memory and time spent on each region.
+///
+/// @param file_name File to save to. Please add the .ply extension.
+/// @param map The map to save. Must have been opened via @c ohm::openIndexed() .
+/// @param opt Additional export controls.
+/// @param prog Optional function called to report on progress.
+/// @return The number of points saved.
+uint64_t ohmtools_API streamCloud(const std::string &file_name, ohm::OccupancyMap &map,
+                                  const SaveCloudOptions &opt = SaveCloudOptions(),
+                                  const ProgressCallback &prog = ProgressCallback());
+
+/// A streaming variant of @c saveDensityCloud() . See @c streamCloud() .
+/// @param file_name File to save to. Please add the .ply extension.
+/// @param map The map to save. Must have been opened via @c ohm::openIndexed() .
+/// @param opt Additional export controls.
+/// @param prog Optional function called to report on progress.
+/// @return The number of points saved.
+uint64_t ohmtools_API streamDensityCloud(const std::string &file_name, ohm::OccupancyMap &map,
+                                         const SaveDensityCloudOptions &opt = SaveDensityCloudOptions(),
+                                         const ProgressCallback &prog = ProgressCallback());
+
+/// Save several point clouds from @p map in a single pass over the map.
+///
+/// Each region is visited once, in parallel, with each export selecting its voxels into per region buffers. The
+/// selected voxels are then coloured and written on the calling thread in region order, so the output of each export
+/// matches the equivalent @c saveCloud() or @c saveDensityCloud() call. Exports which are not supported by the map,
+/// or whose file cannot be written, report a zero @c CloudExport::point_count .
+///
+/// @param exports The clouds to save. The @c CloudExport::point_count of each is set.
+/// @param map The map to save.
+/// @param prog Optional function called to report on progress.
+/// @return The total number of points saved.
+uint64_t ohmtools_API saveClouds(std::vector<CloudExport> &exports, const ohm::OccupancyMap &map,
+                                 const ProgressCallback &prog = ProgressCallback());
+
+/// A streaming variant of @c saveClouds() . See @c streamCloud() .
+/// @param exports The clouds to save. The @c CloudExport::point_count of each is set.
+/// @param map The map to save. Must have been opened via @c ohm::openIndexed() .
+/// @param prog Optional function called to report on progress.
+/// @return The total number of points saved.
+uint64_t ohmtools_API streamClouds(std::vector<CloudExport> &exports, ohm::OccupancyMap &map,
+                                   const ProgressCallback &prog = ProgressCallback());
+
 /// Similar to @c saveCloud() exporting voxels as a series of cube meshes.
 /// @param file_name File to save to. Please add the .ply extension.
 /// @param map The map to save.
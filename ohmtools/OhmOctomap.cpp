@@ -0,0 +1,454 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmOctomap.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapRegion.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/ParallelForEach.h>
+#include <ohm/VoxelOccupancy.h>
+#include <ohm/VoxelSpan.h>
+
+#include <octomap/OcTree.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace ohmtools
+{
+namespace
+{
+/// Depth of an Octomap tree; the number of bits in an @c octomap::key_type .
+const unsigned kTreeDepth = 16;
+
+/// An octree leaf awaiting insertion into an @c octomap::OcTree .
+struct OctreeLeaf
+{
+  /// Interleaved (Morton) key of the first voxel covered by the leaf. Sorting by this code gives depth first octree
+  /// order.
+  uint64_t morton;
+  /// Leaf log odds occupancy value.
+  float value;
+  /// Leaf level above the maximum tree depth. Level zero is a single voxel, while level @c n covers @c 2^n voxels
+  /// along each axis.
+  unsigned level;
+};
+
+/// An Octomap leaf to import, expressed in map wide voxel index coordinates.
+struct OctreeBlock
+{
+  glm::ivec3 min;  ///< First voxel covered by the leaf.
+  int size;        ///< Voxels covered along each axis.
+  float value;     ///< Leaf log odds occupancy value.
+};
+
+
+/// Spread the low 21 bits of @p value to every third bit.
+inline uint64_t spreadBits(uint64_t value)
+{
+  value &= 0x1fffffull;
+  value = (value | value << 32u) & 0x1f00000000ffffull;
+  value = (value | value << 16u) & 0x1f0000ff0000ffull;
+  value = (value | value << 8u) & 0x100f00f00f00f00full;
+  value = (value | value << 4u) & 0x10c30c30c30c30c3ull;
+  value = (value | value << 2u) & 0x1249249249249249ull;
+  return value;
+}
+
+
+/// Inverse of @c spreadBits() .
+inline uint64_t compactBits(uint64_t value)
+{
+  value &= 0x1249249249249249ull;
+  value = (value ^ (value >> 2u)) & 0x10c30c30c30c30c3ull;
+  value = (value ^ (value >> 4u)) & 0x100f00f00f00f00full;
+  value = (value ^ (value >> 8u)) & 0x1f0000ff0000ffull;
+  value = (value ^ (value >> 16u)) & 0x1f00000000ffffull;
+  value = (value ^ (value >> 32u)) & 0x1fffffull;
+  return value;
+}
+
+
+/// Interleave an Octomap key such that the three bits at each key bit match @c octomap::computeChildIdx() .
+inline uint64_t mortonCode(unsigned x, unsigned y, unsigned z)
+{
+  return spreadBits(x) | (spreadBits(y) << 1u) | (spreadBits(z) << 2u);
+}
+
+
+/// Decode a @c mortonCode() .
+inline octomap::OcTreeKey mortonKey(uint64_t morton)
+{
+  return octomap::OcTreeKey(octomap::key_type(compactBits(morton)), octomap::key_type(compactBits(morton >> 1u)),
+                            octomap::key_type(compactBits(morton >> 2u)));
+}
+
+
+/// Index of the highest set bit in non zero @p value .
+inline unsigned highestBit(uint64_t value)
+{
+  unsigned bit = 0;
+  while (value >>= 1u)
+  {
+    ++bit;
+  }
+  return bit;
+}
+
+
+/// Floored integer division, rounding towards negative infinity.
+inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+
+/// Resolve the Octomap key of the map voxel at map wide index zero.
+/// @return False if out of the Octomap key range.
+bool resolveKeyOffset(const ohm::OccupancyMap &map, const octomap::OcTree &tree, glm::ivec3 *key_offset)
+{
+  const glm::dvec3 voxel_zero = map.voxelCentreGlobal(ohm::Key(glm::i16vec3(0), glm::u8vec3(0)));
+  for (int i = 0; i < 3; ++i)
+  {
+    octomap::key_type key = 0;
+    if (!tree.coordToKeyChecked(voxel_zero[i], key))
+    {
+      return false;
+    }
+    (*key_offset)[i] = int(key);
+  }
+  return true;
+}
+
+
+/// Collapse complete octants of leaves with equal values into a single leaf at the next level, bottom up.
+/// @param leaves The leaves, sorted by @c OctreeLeaf::morton .
+void collapseLeaves(std::vector<OctreeLeaf> &leaves)
+{
+  unsigned max_level = 0;
+  for (const OctreeLeaf &leaf : leaves)
+  {
+    max_level = std::max(max_level, leaf.level);
+  }
+
+  for (unsigned level = 0; level <= max_level && level < kTreeDepth; ++level)
+  {
+    const unsigned parent_shift = 3u * (level + 1u);
+    size_t write = 0;
+    size_t i = 0;
+    while (i < leaves.size())
+    {
+      // Leaves don't overlap, so eight consecutive leaves at this level with the same parent are a complete octant.
+      bool complete = i + 8u <= leaves.size();
+      for (size_t j = i; complete && j < i + 8u; ++j)
+      {
+        complete = leaves[j].level == level && leaves[j].value == leaves[i].value &&
+                   (leaves[j].morton >> parent_shift) == (leaves[i].morton >> parent_shift);
+      }
+
+      if (complete)
+      {
+        leaves[write] = leaves[i];
+        leaves[write].level = level + 1u;
+        max_level = std::max(max_level, level + 1u);
+        i += 8u;
+      }
+      else
+      {
+        leaves[write] = leaves[i++];
+      }
+      ++write;
+    }
+    leaves.resize(write);
+  }
+}
+
+
+/// Recursively delete the children of @p node , deepest first.
+void deleteChildren(octomap::OcTree &tree, octomap::OcTreeNode *node)
+{
+  for (unsigned i = 0; i < 8u; ++i)
+  {
+    if (tree.nodeChildExists(node, i))
+    {
+      deleteChildren(tree, tree.getNodeChild(node, i));
+      tree.deleteNodeChild(node, i);
+    }
+  }
+}
+
+
+/// Insert sorted @p leaves into the empty @p tree in depth first order, reusing the path from the previous leaf.
+void insertLeaves(octomap::OcTree &tree, const std::vector<OctreeLeaf> &leaves)
+{
+  if (leaves.empty())
+  {
+    return;
+  }
+
+  // Octomap does not expose root creation. Setting the first leaf creates the root with a path to full depth.
+  tree.setNodeValue(mortonKey(leaves.front().morton), leaves.front().value, true);
+
+  std::vector<octomap::OcTreeNode *> path(kTreeDepth + 1u, nullptr);
+  path[0] = tree.getRoot();
+  unsigned path_depth = 0;
+  uint64_t last_morton = leaves.front().morton;
+
+  for (const OctreeLeaf &leaf : leaves)
+  {
+    // Nodes above the highest differing key bit are shared with the previous leaf.
+    const uint64_t diff = leaf.morton ^ last_morton;
+    const unsigned shared_depth = (diff) ? kTreeDepth - 1u - highestBit(diff) / 3u : kTreeDepth;
+    const unsigned target_depth = kTreeDepth - leaf.level;
+    for (unsigned depth = std::min(shared_depth, path_depth); depth < target_depth; ++depth)
+    {
+      const unsigned child = unsigned(leaf.morton >> (3u * (kTreeDepth - 1u - depth))) & 7u;
+      if (!tree.nodeChildExists(path[depth], child))
+      {
+        tree.createNodeChild(path[depth], child);
+      }
+      path[depth + 1] = tree.getNodeChild(path[depth], child);
+    }
+
+    octomap::OcTreeNode *node = path[target_depth];
+    // Only the first leaf may have children; the path created with the root.
+    if (tree.nodeHasChildren(node))
+    {
+      deleteChildren(tree, node);
+    }
+    node->setLogOdds(leaf.value);
+
+    path_depth = target_depth;
+    last_morton = leaf.morton;
+  }
+
+  tree.updateInnerOccupancy();
+}
+}  // namespace
+
+
+size_t exportOctomap(const ohm::OccupancyMap &map, octomap::OcTree &tree, bool use_threads)
+{
+  tree.clear();
+  tree.setResolution(map.resolution());
+  tree.setProbHit(map.hitProbability());
+  tree.setProbMiss(map.missProbability());
+  tree.setOccupancyThres(map.occupancyThresholdProbability());
+  tree.setClampingThresMin(map.minVoxelProbability());
+  tree.setClampingThresMax(map.maxVoxelProbability());
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  glm::ivec3 key_offset(0);
+  if (occupancy_layer < 0 || !resolveKeyOffset(map, tree, &key_offset))
+  {
+    return 0;
+  }
+
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  std::vector<std::vector<OctreeLeaf>> region_leaves(chunks.size());
+  std::vector<size_t> region_counts(chunks.size(), 0u);
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  const int max_key = std::numeric_limits<octomap::key_type>::max();
+
+  // Convert each region into a sorted list of collapsed leaves.
+  ohm::parallelForEachRegion(
+    chunks,
+    [&](const ohm::MapChunk &chunk, size_t region_index, unsigned /*worker_index*/)  //
+    {
+      const ohm::VoxelSpan<const float> occupancy(&chunk, map, occupancy_layer);
+      if (!occupancy.isValid())
+      {
+        return;
+      }
+
+      std::vector<OctreeLeaf> &leaves = region_leaves[region_index];
+      const ohm::VoxelKeyDecoder &decoder = occupancy.keyDecoder();
+      const glm::ivec3 base = glm::ivec3(chunk.region.coord) * region_dim + key_offset;
+      for (size_t i = 0; i < occupancy.size(); ++i)
+      {
+        const float value = occupancy[i];
+        if (value == ohm::unobservedOccupancyValue())
+        {
+          continue;
+        }
+
+        const glm::ivec3 key = base + glm::ivec3(decoder.localKey(i));
+        if (glm::any(glm::lessThan(key, glm::ivec3(0))) || glm::any(glm::greaterThan(key, glm::ivec3(max_key))))
+        {
+          // Outside the Octomap key range.
+          continue;
+        }
+
+        OctreeLeaf leaf;
+        leaf.morton = mortonCode(unsigned(key.x), unsigned(key.y), unsigned(key.z));
+        leaf.value = value;
+        leaf.level = 0;
+        leaves.emplace_back(leaf);
+      }
+
+      region_counts[region_index] = leaves.size();
+      std::sort(leaves.begin(), leaves.end(),
+                [](const OctreeLeaf &a, const OctreeLeaf &b) { return a.morton < b.morton; });
+      collapseLeaves(leaves);
+    },
+    use_threads);
+
+  // Merge the regions and collapse octants spanning regions.
+  size_t leaf_count = 0;
+  size_t voxel_count = 0;
+  for (size_t i = 0; i < region_leaves.size(); ++i)
+  {
+    leaf_count += region_leaves[i].size();
+    voxel_count += region_counts[i];
+  }
+
+  std::vector<OctreeLeaf> leaves;
+  leaves.reserve(leaf_count);
+  for (std::vector<OctreeLeaf> &region : region_leaves)
+  {
+    leaves.insert(leaves.end(), region.begin(), region.end());
+    std::vector<OctreeLeaf>().swap(region);
+  }
+  std::sort(leaves.begin(), leaves.end(), [](const OctreeLeaf &a, const OctreeLeaf &b) { return a.morton < b.morton; });
+  collapseLeaves(leaves);
+
+  insertLeaves(tree, leaves);
+  return voxel_count;
+}
+
+
+size_t importOctomap(ohm::OccupancyMap &map, const octomap::OcTree &tree, bool use_threads)
+{
+  const int occupancy_layer = map.layout().occupancyLayer();
+  glm::ivec3 key_offset(0);
+  if (occupancy_layer < 0 || std::abs(tree.getResolution() - map.resolution()) > 1e-6 * map.resolution() ||
+      !resolveKeyOffset(map, tree, &key_offset))
+  {
+    return 0;
+  }
+
+  map.setHitProbability(float(tree.getProbHit()));
+  map.setMissProbability(float(tree.getProbMiss()));
+  map.setOccupancyThresholdProbability(float(tree.getOccupancyThres()));
+  map.setMinVoxelProbability(float(tree.getClampingThresMin()));
+  map.setMaxVoxelProbability(float(tree.getClampingThresMax()));
+
+  // Collect the leaves and the regions they overlap.
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  const int region_min = std::numeric_limits<int16_t>::min();
+  const int region_max = std::numeric_limits<int16_t>::max();
+  std::vector<OctreeBlock> blocks;
+  std::unordered_map<glm::i16vec3, std::vector<size_t>, ohm::MapRegion::Hash> region_blocks;
+  for (auto leaf = tree.begin_leafs(); leaf != tree.end_leafs(); ++leaf)
+  {
+    OctreeBlock block;
+    block.size = 1 << (kTreeDepth - leaf.getDepth());
+    block.value = leaf->getLogOdds();
+    const octomap::OcTreeKey key = leaf.getKey();
+    for (int i = 0; i < 3; ++i)
+    {
+      block.min[i] = int(key[i] & ~unsigned(block.size - 1)) - key_offset[i];
+    }
+
+    const glm::ivec3 region_from(floorDiv(block.min.x, region_dim.x), floorDiv(block.min.y, region_dim.y),
+                                 floorDiv(block.min.z, region_dim.z));
+    const glm::ivec3 region_to(floorDiv(block.min.x + block.size - 1, region_dim.x),
+                               floorDiv(block.min.y + block.size - 1, region_dim.y),
+                               floorDiv(block.min.z + block.size - 1, region_dim.z));
+    const glm::ivec3 clamped_from = glm::max(region_from, glm::ivec3(region_min));
+    const glm::ivec3 clamped_to = glm::min(region_to, glm::ivec3(region_max));
+    for (int z = clamped_from.z; z <= clamped_to.z; ++z)
+    {
+      for (int y = clamped_from.y; y <= clamped_to.y; ++y)
+      {
+        for (int x = clamped_from.x; x <= clamped_to.x; ++x)
+        {
+          region_blocks[glm::i16vec3(x, y, z)].emplace_back(blocks.size());
+        }
+      }
+    }
+    blocks.emplace_back(block);
+  }
+
+  // Create regions serially, then populate them in parallel.
+  std::vector<const ohm::MapChunk *> chunks;
+  std::vector<const std::vector<size_t> *> chunk_blocks;
+  chunks.reserve(region_blocks.size());
+  chunk_blocks.reserve(region_blocks.size());
+  for (const auto &region : region_blocks)
+  {
+    chunks.emplace_back(map.region(region.first, true));
+    chunk_blocks.emplace_back(&region.second);
+  }
+
+  const uint64_t stamp = map.touch();
+  std::vector<size_t> region_counts(chunks.size(), 0u);
+  ohm::parallelForEachRegion(
+    chunks,
+    [&](const ohm::MapChunk &chunk, size_t region_index, unsigned /*worker_index*/)  //
+    {
+      // The map is mutable, so its chunks are too.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      ohm::MapChunk &target_chunk = const_cast<ohm::MapChunk &>(chunk);
+      ohm::VoxelSpan<float> occupancy(&target_chunk, map, occupancy_layer);
+      if (!occupancy.isValid())
+      {
+        return;
+      }
+
+      const ohm::VoxelKeyDecoder &decoder = occupancy.keyDecoder();
+      const glm::ivec3 base = glm::ivec3(chunk.region.coord) * region_dim;
+      size_t count = 0;
+      for (size_t block_index : *chunk_blocks[region_index])
+      {
+        // Fill the part of the block overlapping this region.
+        const OctreeBlock &block = blocks[block_index];
+        const glm::ivec3 from = glm::max(block.min - base, glm::ivec3(0));
+        const glm::ivec3 to = glm::min(block.min + glm::ivec3(block.size) - base, region_dim);
+        glm::u8vec3 local;
+        for (int z = from.z; z < to.z; ++z)
+        {
+          local.z = uint8_t(z);
+          for (int y = from.y; y < to.y; ++y)
+          {
+            local.y = uint8_t(y);
+            for (int x = from.x; x < to.x; ++x)
+            {
+              local.x = uint8_t(x);
+              occupancy[decoder.index(local)] = block.value;
+            }
+          }
+        }
+        // The first valid voxel of a box is its minimum corner.
+        target_chunk.updateFirstValid(glm::u8vec3(from), region_dim);
+        count += size_t(to.x - from.x) * size_t(to.y - from.y) * size_t(to.z - from.z);
+      }
+
+      if (count)
+      {
+        occupancy.touch(stamp);
+      }
+      region_counts[region_index] = count;
+    },
+    use_threads);
+
+  size_t total = 0;
+  for (size_t count : region_counts)
+  {
+    total += count;
+  }
+  return total;
+}
+}  // namespace ohmtools
@@ -0,0 +1,62 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMTOOLS_OHMOCTOMAP_H
+#define OHMTOOLS_OHMOCTOMAP_H
+
+#include "OhmToolsConfig.h"
+
+#include <cstddef>
+
+namespace octomap
+{
+class OcTree;
+}  // namespace octomap
+
+namespace ohm
+{
+class OccupancyMap;
+}  // namespace ohm
+
+namespace ohmtools
+{
+/// Export the occupancy layer of @p map into an Octomap @p tree .
+///
+/// The @p tree is cleared and set to the map resolution, then populated with the log odds occupancy value of each
+/// observed map voxel. Octomap and ohm both use natural log odds, so values are copied without conversion. The map hit,
+/// miss, threshold and clamping probabilities are also copied to the @p tree .
+///
+/// Octomap voxels are anchored at the coordinate origin, so map voxels are mapped to the Octomap voxels containing the
+/// map voxel centres. The result is exact when the map origin is a multiple of the resolution.
+///
+/// The octree is built bottom up rather than by per voxel @c octomap::OcTree::updateNode() calls:
+/// - Map regions are converted in parallel into lists of leaves sorted in octree (Morton) order - see
+///   @c ohm::parallelForEachRegion() . Each list is collapsed bottom up, replacing complete octants of equal value with
+///   a single coarser leaf.
+/// - The lists are merged and collapsed again to join octants spanning regions.
+/// - The leaves are inserted in depth first order, reusing the node path shared with the previous leaf, and the inner
+///   nodes are updated once at the end.
+///
+/// @param map The map to export.
+/// @param tree The tree to export into.
+/// @param use_threads Allow regions to be converted in parallel?
+/// @return The number of map voxels exported.
+size_t ohmtools_API exportOctomap(const ohm::OccupancyMap &map, octomap::OcTree &tree, bool use_threads = true);
+
+/// Import the leaves of an Octomap @p tree into the occupancy layer of @p map . This is the inverse of
+/// @c exportOctomap() .
+///
+/// The @p map resolution must match the @p tree resolution. Leaves above the maximum tree depth are expanded to fill
+/// all the map voxels they cover. Regions are created as required, then populated in parallel. The @p tree hit, miss,
+/// threshold and clamping probabilities are copied to the @p map .
+///
+/// @param map The map to import into.
+/// @param tree The tree to import.
+/// @param use_threads Allow regions to be populated in parallel?
+/// @return The number of map voxels imported or zero if the resolutions do not match.
+size_t ohmtools_API importOctomap(ohm::OccupancyMap &map, const octomap::OcTree &tree, bool use_threads = true);
+}  // namespace ohmtools
+
+#endif  // OHMTOOLS_OHMOCTOMAP_H
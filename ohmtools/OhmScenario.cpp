@@ -0,0 +1,662 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmScenario.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapRegion.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/ParallelForEach.h>
+#include <ohm/TaskArena.h>
+#include <ohm/VoxelSpan.h>
+
+#include <glm/glm.hpp>
+
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <random>
+#include <unordered_set>
+
+namespace ohmgen
+{
+namespace
+{
+/// Offset used to step past a shape boundary when testing carved scenarios.
+const double kBoundaryEpsilon = 1e-6;
+
+bool insideShape(const ScenarioShape &shape, const glm::dvec3 &point)
+{
+  if (glm::any(glm::lessThan(point, shape.min_ext)) || glm::any(glm::greaterThan(point, shape.max_ext)))
+  {
+    return false;
+  }
+
+  if (shape.type == ScenarioShape::kCylinder)
+  {
+    const glm::dvec2 centre = 0.5 * (glm::dvec2(shape.min_ext) + glm::dvec2(shape.max_ext));
+    const double radius = 0.5 * (shape.max_ext.x - shape.min_ext.x);
+    const glm::dvec2 offset = glm::dvec2(point) - centre;
+    return glm::dot(offset, offset) <= radius * radius;
+  }
+
+  return true;
+}
+
+
+/// Calculate the ray parameter interval [ @p t0 , @p t1 ] over which a ray lies within @p shape .
+bool shapeInterval(const ScenarioShape &shape, const glm::dvec3 &origin, const glm::dvec3 &dir, double *t0,
+                   double *t1)
+{
+  double t_min = -std::numeric_limits<double>::infinity();
+  double t_max = std::numeric_limits<double>::infinity();
+  // The cylinder shares the Z slab of its bounds and replaces the X/Y slabs with the circle.
+  const int slab_axes = (shape.type == ScenarioShape::kCylinder) ? 1 : 3;
+  for (int i = 0; i < slab_axes; ++i)
+  {
+    const int axis = (slab_axes == 1) ? 2 : i;
+    if (std::abs(dir[axis]) < std::numeric_limits<double>::epsilon())
+    {
+      if (origin[axis] < shape.min_ext[axis] || origin[axis] > shape.max_ext[axis])
+      {
+        return false;
+      }
+      continue;
+    }
+
+    double near_t = (shape.min_ext[axis] - origin[axis]) / dir[axis];
+    double far_t = (shape.max_ext[axis] - origin[axis]) / dir[axis];
+    if (near_t > far_t)
+    {
+      std::swap(near_t, far_t);
+    }
+    t_min = std::max(t_min, near_t);
+    t_max = std::min(t_max, far_t);
+  }
+
+  if (shape.type == ScenarioShape::kCylinder)
+  {
+    const glm::dvec2 centre = 0.5 * (glm::dvec2(shape.min_ext) + glm::dvec2(shape.max_ext));
+    const double radius = 0.5 * (shape.max_ext.x - shape.min_ext.x);
+    const glm::dvec2 offset = glm::dvec2(origin) - centre;
+    const glm::dvec2 dir2(dir);
+    const double a = glm::dot(dir2, dir2);
+    const double c = glm::dot(offset, offset) - radius * radius;
+    if (a < std::numeric_limits<double>::epsilon())
+    {
+      // Vertical ray.
+      if (c > 0)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      const double b = glm::dot(offset, dir2);
+      const double discriminant = b * b - a * c;
+      if (discriminant < 0)
+      {
+        return false;
+      }
+      const double root = std::sqrt(discriminant);
+      t_min = std::max(t_min, (-b - root) / a);
+      t_max = std::min(t_max, (-b + root) / a);
+    }
+  }
+
+  *t0 = t_min;
+  *t1 = t_max;
+  return t_min <= t_max;
+}
+
+
+/// Generate a random, uniformly distributed value in (0, 1) from @p key , independent of any sequence state.
+double hashUniform(uint64_t key)
+{
+  // splitmix64
+  key += 0x9e3779b97f4a7c15ull;
+  key = (key ^ (key >> 30u)) * 0xbf58476d1ce4e5b9ull;
+  key = (key ^ (key >> 27u)) * 0x94d049bb133111ebull;
+  key ^= key >> 31u;
+  return (double(key >> 11u) + 0.5) * (1.0 / 9007199254740992.0);  // NOLINT(readability-magic-numbers)
+}
+
+
+/// Generate a standard normal value for the ray at @p index using the Box-Muller transform.
+double hashGaussian(uint32_t seed, uint64_t index)
+{
+  const uint64_t key = (uint64_t(seed) << 32u) ^ (2u * index);
+  const double u1 = hashUniform(key);
+  const double u2 = hashUniform(key + 1u);
+  return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+
+
+void generateUrban(Scenario &scenario, const ScenarioParams &params, std::mt19937 &rng)
+{
+  const glm::dvec3 &ext = params.extents;
+  scenario.addBox(glm::dvec3(0, 0, -1), glm::dvec3(ext.x, ext.y, 0));
+
+  const double block = std::max(params.block_size, params.street_width + 1.0);
+  const int blocks_x = std::max(1, int(ext.x / block));
+  const int blocks_y = std::max(1, int(ext.y / block));
+  const double footprint = block - params.street_width;
+  std::uniform_real_distribution<double> inset(0.0, 0.1 * footprint);
+  std::uniform_real_distribution<double> height(params.min_building_height,
+                                                std::max(params.min_building_height, ext.z));
+  for (int by = 0; by < blocks_y; ++by)
+  {
+    for (int bx = 0; bx < blocks_x; ++bx)
+    {
+      const glm::dvec3 block_min(bx * block + 0.5 * params.street_width, by * block + 0.5 * params.street_width, 0);
+      glm::dvec3 min_ext = block_min + glm::dvec3(inset(rng), inset(rng), 0);
+      glm::dvec3 max_ext = block_min + glm::dvec3(footprint - inset(rng), footprint - inset(rng), height(rng));
+      scenario.addBox(min_ext, max_ext);
+    }
+  }
+
+  // Serpentine along the streets between the block columns.
+  std::vector<glm::dvec3> path;
+  for (int street = 0; street <= blocks_x; ++street)
+  {
+    const double x = street * block;
+    const bool up = (street % 2) == 0;
+    path.emplace_back(x, (up) ? 0.0 : blocks_y * block, params.path_height);
+    path.emplace_back(x, (up) ? blocks_y * block : 0.0, params.path_height);
+  }
+  scenario.setPath(path);
+}
+
+
+void generateForest(Scenario &scenario, const ScenarioParams &params, std::mt19937 &rng)
+{
+  const glm::dvec3 &ext = params.extents;
+  scenario.addBox(glm::dvec3(0, 0, -1), glm::dvec3(ext.x, ext.y, 0));
+
+  const double track_y = 0.5 * ext.y;
+  const size_t tree_count = size_t(std::max(0.0, params.tree_density * ext.x * ext.y));
+  std::uniform_real_distribution<double> rand_x(0.0, ext.x);
+  std::uniform_real_distribution<double> rand_y(0.0, ext.y);
+  std::uniform_real_distribution<double> rand_radius(params.min_trunk_radius,
+                                                     std::max(params.min_trunk_radius, params.max_trunk_radius));
+  for (size_t i = 0; i < tree_count; ++i)
+  {
+    const glm::dvec3 base(rand_x(rng), rand_y(rng), 0);
+    const double radius = rand_radius(rng);
+    // Rejected trees keep the track clear.
+    if (std::abs(base.y - track_y) >= 0.5 * params.track_width + radius)
+    {
+      scenario.addCylinder(base, radius, ext.z);
+    }
+  }
+
+  scenario.setPath({ glm::dvec3(0, track_y, params.path_height), glm::dvec3(ext.x, track_y, params.path_height) });
+}
+
+
+void generateTunnel(Scenario &scenario, const ScenarioParams &params, std::mt19937 &rng)
+{
+  const double segment_length = std::max(params.segment_length, params.tunnel_width);
+  const int segment_count = std::max(1, int(std::ceil(params.extents.x / segment_length)));
+  std::bernoulli_distribution turn_left(0.5);
+
+  // Alternate segments along X and along a random Y direction.
+  std::vector<glm::dvec3> centreline;
+  centreline.emplace_back(0.0);
+  for (int i = 0; i < segment_count; ++i)
+  {
+    glm::dvec3 step(0.0);
+    if (i % 2 == 0)
+    {
+      step.x = segment_length;
+    }
+    else
+    {
+      step.y = (turn_left(rng)) ? segment_length : -segment_length;
+    }
+    centreline.emplace_back(centreline.back() + step);
+  }
+
+  const glm::dvec3 half_width(0.5 * params.tunnel_width, 0.5 * params.tunnel_width, 0);
+  glm::dvec3 min_ext(std::numeric_limits<double>::max());
+  glm::dvec3 max_ext(std::numeric_limits<double>::lowest());
+  for (const glm::dvec3 &point : centreline)
+  {
+    min_ext = glm::min(min_ext, point);
+    max_ext = glm::max(max_ext, point);
+  }
+
+  // Solid rock around the tunnel, then carve out the segments.
+  const double rock = std::max(2.0, params.tunnel_width);
+  scenario.addBox(min_ext - half_width - glm::dvec3(rock, rock, rock),
+                  max_ext + half_width + glm::dvec3(rock, rock, params.tunnel_height + rock));
+  for (size_t i = 1; i < centreline.size(); ++i)
+  {
+    const glm::dvec3 seg_min = glm::min(centreline[i - 1], centreline[i]) - half_width;
+    const glm::dvec3 seg_max =
+      glm::max(centreline[i - 1], centreline[i]) + half_width + glm::dvec3(0, 0, params.tunnel_height);
+    scenario.addBox(seg_min, seg_max, true);
+  }
+
+  std::vector<glm::dvec3> path;
+  const double path_height = std::min(params.path_height, 0.5 * params.tunnel_height);
+  for (const glm::dvec3 &point : centreline)
+  {
+    path.emplace_back(point.x, point.y, path_height);
+  }
+  scenario.setPath(path);
+}
+
+
+/// Interpolate the trajectory position at @p time , clamping to the trajectory time range.
+glm::dvec3 trajectoryPosition(const std::vector<TrajectorySample> &trajectory, double time)
+{
+  const auto next = std::upper_bound(trajectory.begin(), trajectory.end(), time,
+                                     [](double t, const TrajectorySample &sample) { return t < sample.timestamp; });
+  if (next == trajectory.begin())
+  {
+    return trajectory.front().position;
+  }
+  if (next == trajectory.end())
+  {
+    return trajectory.back().position;
+  }
+
+  const TrajectorySample &prev = *(next - 1);
+  const double dt = next->timestamp - prev.timestamp;
+  const double lerp = (dt > 0) ? (time - prev.timestamp) / dt : 0.0;
+  return prev.position + lerp * (next->position - prev.position);
+}
+}  // namespace
+
+
+Scenario Scenario::generate(const ScenarioParams &params)
+{
+  Scenario scenario;
+  std::mt19937 rng(params.seed);
+  switch (params.type)
+  {
+  case ScenarioType::kForest:
+    generateForest(scenario, params, rng);
+    break;
+  case ScenarioType::kTunnel:
+    generateTunnel(scenario, params, rng);
+    break;
+  case ScenarioType::kUrban:
+  default:
+    generateUrban(scenario, params, rng);
+    break;
+  }
+  return scenario;
+}
+
+
+void Scenario::addBox(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext, bool carve)
+{
+  ScenarioShape shape;
+  shape.min_ext = glm::min(min_ext, max_ext);
+  shape.max_ext = glm::max(min_ext, max_ext);
+  shape.type = ScenarioShape::kBox;
+  shape.carve = carve;
+  shapes_.emplace_back(shape);
+  expandExtents(shape);
+}
+
+
+void Scenario::addCylinder(const glm::dvec3 &base_centre, double radius, double height)
+{
+  ScenarioShape shape;
+  shape.min_ext = base_centre - glm::dvec3(radius, radius, 0);
+  shape.max_ext = base_centre + glm::dvec3(radius, radius, height);
+  shape.type = ScenarioShape::kCylinder;
+  shapes_.emplace_back(shape);
+  expandExtents(shape);
+}
+
+
+Scenario Scenario::overlapping(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext) const
+{
+  Scenario subset;
+  for (const ScenarioShape &shape : shapes_)
+  {
+    if (glm::all(glm::lessThanEqual(shape.min_ext, max_ext)) && glm::all(glm::greaterThanEqual(shape.max_ext, min_ext)))
+    {
+      subset.shapes_.emplace_back(shape);
+      subset.expandExtents(shape);
+    }
+  }
+  return subset;
+}
+
+
+bool Scenario::occupied(const glm::dvec3 &point) const
+{
+  bool solid = false;
+  for (const ScenarioShape &shape : shapes_)
+  {
+    if (insideShape(shape, point))
+    {
+      if (shape.carve)
+      {
+        return false;
+      }
+      solid = true;
+    }
+  }
+  return solid;
+}
+
+
+bool Scenario::raycast(const glm::dvec3 &origin, const glm::dvec3 &dir, double max_range, double *range) const
+{
+  double t0 = 0;
+  double t1 = 0;
+  if (!has_carved_)
+  {
+    // The first solid entry is the hit.
+    double nearest = std::numeric_limits<double>::infinity();
+    for (const ScenarioShape &shape : shapes_)
+    {
+      if (shapeInterval(shape, origin, dir, &t0, &t1) && t1 >= 0)
+      {
+        nearest = std::min(nearest, std::max(t0, 0.0));
+      }
+    }
+    *range = nearest;
+    return nearest <= max_range;
+  }
+
+  // With carved shapes, the hit is at a solid entry or a carved exit. Test the candidates in range order.
+  std::vector<double> candidates;
+  for (const ScenarioShape &shape : shapes_)
+  {
+    if (shapeInterval(shape, origin, dir, &t0, &t1) && t1 >= 0)
+    {
+      candidates.emplace_back((shape.carve) ? t1 : std::max(t0, 0.0));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  for (const double t : candidates)
+  {
+    if (t > max_range)
+    {
+      break;
+    }
+    if (occupied(origin + (t + kBoundaryEpsilon) * dir))
+    {
+      *range = t;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void Scenario::expandExtents(const ScenarioShape &shape)
+{
+  if (shape.carve)
+  {
+    has_carved_ = true;
+    return;
+  }
+
+  min_ext_ = (has_solid_) ? glm::min(min_ext_, shape.min_ext) : shape.min_ext;
+  max_ext_ = (has_solid_) ? glm::max(max_ext_, shape.max_ext) : shape.max_ext;
+  has_solid_ = true;
+}
+
+
+bool parseScenarioType(const std::string &name, ScenarioType *type)
+{
+  if (name == "urban")
+  {
+    *type = ScenarioType::kUrban;
+  }
+  else if (name == "forest")
+  {
+    *type = ScenarioType::kForest;
+  }
+  else if (name == "tunnel")
+  {
+    *type = ScenarioType::kTunnel;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
+
+
+size_t generateTrajectory(const Scenario &scenario, double speed, double interval,
+                          std::vector<TrajectorySample> &trajectory, double start_time)
+{
+  const std::vector<glm::dvec3> &path = scenario.path();
+  if (path.empty() || speed <= 0 || interval <= 0)
+  {
+    return 0;
+  }
+
+  const size_t initial_size = trajectory.size();
+  const double step = speed * interval;
+  double time = start_time;
+  trajectory.emplace_back(TrajectorySample{ time, path.front() });
+  // Distance to travel along the current segment before the next sample.
+  double next_sample = step;
+  for (size_t i = 1; i < path.size(); ++i)
+  {
+    const glm::dvec3 segment = path[i] - path[i - 1];
+    const double length = glm::length(segment);
+    double travelled = 0;
+    while (length - travelled >= next_sample)
+    {
+      travelled += next_sample;
+      time += interval;
+      trajectory.emplace_back(TrajectorySample{ time, path[i - 1] + (travelled / length) * segment });
+      next_sample = step;
+    }
+    next_sample -= length - travelled;
+  }
+
+  // Finish at the end of the path.
+  if (glm::length(path.back() - trajectory.back().position) > kBoundaryEpsilon)
+  {
+    time += interval * (1.0 - next_sample / step);
+    trajectory.emplace_back(TrajectorySample{ time, path.back() });
+  }
+
+  return trajectory.size() - initial_size;
+}
+
+
+size_t generateRays(const Scenario &scenario, const std::vector<TrajectorySample> &trajectory,
+                    const LidarParams &lidar, std::vector<glm::dvec3> &rays, std::vector<double> *timestamps,
+                    bool use_threads)
+{
+  if (trajectory.empty() || lidar.beam_count == 0 || lidar.azimuth_samples == 0 || lidar.scan_rate <= 0)
+  {
+    return 0;
+  }
+
+  const double column_interval = 1.0 / (lidar.scan_rate * lidar.azimuth_samples);
+  const double start_time = trajectory.front().timestamp;
+  const size_t column_count = size_t((trajectory.back().timestamp - start_time) / column_interval) + 1u;
+  const size_t ray_count = column_count * lidar.beam_count;
+  const double min_elevation = glm::radians(lidar.min_elevation_deg);
+  const double elevation_step =
+    (lidar.beam_count > 1) ? glm::radians(lidar.max_elevation_deg - lidar.min_elevation_deg) / (lidar.beam_count - 1) :
+                             0.0;
+
+  // Cast into fixed slots so the output order is independent of threading, then compact.
+  std::vector<glm::dvec3> origins(column_count);
+  std::vector<glm::dvec3> samples(ray_count);
+  std::vector<uint8_t> valid(ray_count, 0u);
+
+  const auto cast_columns = [&](size_t begin, size_t end) {
+    for (size_t column = begin; column < end; ++column)
+    {
+      const glm::dvec3 origin = trajectoryPosition(trajectory, start_time + double(column) * column_interval);
+      const double azimuth = 2.0 * M_PI * double(column % lidar.azimuth_samples) / double(lidar.azimuth_samples);
+      origins[column] = origin;
+      for (unsigned beam = 0; beam < lidar.beam_count; ++beam)
+      {
+        const size_t ray_index = column * lidar.beam_count + beam;
+        const double elevation = min_elevation + beam * elevation_step;
+        const glm::dvec3 dir(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth),
+                             std::sin(elevation));
+        double range = lidar.max_range;
+        const bool hit = scenario.raycast(origin, dir, lidar.max_range, &range);
+        if (hit && lidar.range_noise > 0)
+        {
+          range = std::max(0.0, range + lidar.range_noise * hashGaussian(lidar.seed, ray_index));
+        }
+        if (hit || lidar.include_misses)
+        {
+          samples[ray_index] = origin + ((hit) ? range : lidar.max_range) * dir;
+          valid[ray_index] = 1u;
+        }
+      }
+    }
+  };
+
+#ifdef OHM_FEATURE_THREADS
+  if (use_threads)
+  {
+    ohm::parallelExecute([&]() {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, column_count),
+                        [&cast_columns](const tbb::blocked_range<size_t> &range) {
+                          cast_columns(range.begin(), range.end());
+                        });
+    });
+  }
+  else
+#endif  // OHM_FEATURE_THREADS
+  {
+    (void)use_threads;
+    cast_columns(0, column_count);
+  }
+
+  const size_t initial_size = rays.size();
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    if (valid[i])
+    {
+      const size_t column = i / lidar.beam_count;
+      rays.emplace_back(origins[column]);
+      rays.emplace_back(samples[i]);
+      if (timestamps)
+      {
+        timestamps->emplace_back(start_time + double(column) * column_interval);
+      }
+    }
+  }
+
+  return (rays.size() - initial_size) / 2;
+}
+
+
+size_t populateMap(ohm::OccupancyMap &map, const Scenario &scenario, bool fill_free, bool use_threads)
+{
+  const int occupancy_layer = map.layout().occupancyLayer();
+  if (occupancy_layer < 0 || scenario.shapes().empty())
+  {
+    return 0;
+  }
+
+  // Collect the regions to fill.
+  std::unordered_set<glm::i16vec3, ohm::MapRegion::Hash> region_keys;
+  const auto add_regions = [&map, &region_keys](const glm::dvec3 &min_ext, const glm::dvec3 &max_ext) {
+    const glm::i16vec3 min_region = map.voxelKey(min_ext).regionKey();
+    const glm::i16vec3 max_region = map.voxelKey(max_ext).regionKey();
+    glm::ivec3 region;
+    for (region.z = min_region.z; region.z <= max_region.z; ++region.z)
+    {
+      for (region.y = min_region.y; region.y <= max_region.y; ++region.y)
+      {
+        for (region.x = min_region.x; region.x <= max_region.x; ++region.x)
+        {
+          region_keys.insert(glm::i16vec3(region));
+        }
+      }
+    }
+  };
+
+  if (fill_free)
+  {
+    add_regions(scenario.minExtents(), scenario.maxExtents());
+  }
+  else
+  {
+    for (const ScenarioShape &shape : scenario.shapes())
+    {
+      if (!shape.carve)
+      {
+        add_regions(shape.min_ext, shape.max_ext);
+      }
+    }
+  }
+
+  // Regions must be created before visiting in parallel.
+  std::vector<const ohm::MapChunk *> chunks;
+  chunks.reserve(region_keys.size());
+  for (const glm::i16vec3 &region_key : region_keys)
+  {
+    chunks.emplace_back(map.region(region_key, true));
+  }
+
+  const uint64_t stamp = map.touch();
+  const float occupied_value = map.occupancyThresholdValue();
+  const float free_value = map.missValue();
+  const glm::ivec3 region_dim = map.regionVoxelDimensions();
+  const glm::dvec3 half_region = 0.5 * map.regionSpatialResolution();
+  std::atomic<size_t> occupied_count{ 0 };
+
+  ohm::parallelForEachRegion(
+    chunks,
+    [&](const ohm::MapChunk &chunk, size_t /*region_index*/, unsigned /*worker_index*/)  //
+    {
+      // The map is mutable, so its chunks are too.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      auto *mutable_chunk = const_cast<ohm::MapChunk *>(&chunk);
+      ohm::VoxelSpan<float> occupancy(mutable_chunk, map, occupancy_layer);
+      if (!occupancy.isValid())
+      {
+        return;
+      }
+
+      // Only test the shapes near this region.
+      const Scenario local = scenario.overlapping(chunk.region.centre - half_region, chunk.region.centre + half_region);
+      size_t count = 0;
+      for (size_t i = 0; i < occupancy.size(); ++i)
+      {
+        const glm::dvec3 centre = map.voxelCentreGlobal(occupancy.keyDecoder().key(i));
+        if (local.occupied(centre))
+        {
+          occupancy[i] = occupied_value;
+          ++count;
+        }
+        else if (fill_free && glm::all(glm::greaterThanEqual(centre, scenario.minExtents())) &&
+                 glm::all(glm::lessThanEqual(centre, scenario.maxExtents())))
+        {
+          occupancy[i] = free_value;
+        }
+      }
+
+      mutable_chunk->searchAndUpdateFirstValid(region_dim);
+      occupancy.touch(stamp);
+      occupied_count += count;
+    },
+    use_threads);
+
+  return occupied_count;
+}
+}  // namespace ohmgen
@@ -0,0 +1,250 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMTOOLS_OHMSCENARIO_H
+#define OHMTOOLS_OHMSCENARIO_H
+
+#include "OhmToolsConfig.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+}  // namespace ohm
+
+namespace ohmgen
+{
+/// The procedural environments supported by @c Scenario::generate() .
+enum class ScenarioType : int
+{
+  /// A grid of city blocks with buildings of random height, separated by streets, on a ground plane.
+  kUrban,
+  /// Randomly placed tree trunks on a ground plane with a clear track through the middle.
+  kForest,
+  /// A winding tunnel of axis aligned segments carved out of solid rock.
+  kTunnel
+};
+
+/// Parameters for @c Scenario::generate() . Members are grouped by the @c ScenarioType they apply to.
+struct ohmtools_API ScenarioParams
+{
+  /// The environment type.
+  ScenarioType type = ScenarioType::kUrban;
+  /// Random number seed. The same parameters and seed always generate the same scenario.
+  uint32_t seed = 0;
+  /// Horizontal extents of the environment (X, Y) and the maximum feature height (Z). The environment spans
+  /// [0, extents] in X and Y. For a tunnel, X sets the total tunnel length and Y is ignored.
+  glm::dvec3 extents{ 100.0, 100.0, 20.0 };  // NOLINT(readability-magic-numbers)
+  /// Height of the trajectory @c Scenario::path() above the ground or tunnel floor.
+  double path_height = 1.5;  // NOLINT(readability-magic-numbers)
+
+  /// Urban: city block size along each axis, including the street.
+  double block_size = 30.0;  // NOLINT(readability-magic-numbers)
+  /// Urban: street width.
+  double street_width = 10.0;  // NOLINT(readability-magic-numbers)
+  /// Urban: minimum building height. Building heights are random in [min_building_height, extents.z].
+  double min_building_height = 5.0;  // NOLINT(readability-magic-numbers)
+
+  /// Forest: number of trees per square metre.
+  double tree_density = 0.05;  // NOLINT(readability-magic-numbers)
+  /// Forest: minimum tree trunk radius.
+  double min_trunk_radius = 0.1;  // NOLINT(readability-magic-numbers)
+  /// Forest: maximum tree trunk radius.
+  double max_trunk_radius = 0.4;  // NOLINT(readability-magic-numbers)
+  /// Forest: width of the clear track through the trees.
+  double track_width = 4.0;  // NOLINT(readability-magic-numbers)
+
+  /// Tunnel: tunnel width.
+  double tunnel_width = 4.0;  // NOLINT(readability-magic-numbers)
+  /// Tunnel: tunnel height.
+  double tunnel_height = 3.0;  // NOLINT(readability-magic-numbers)
+  /// Tunnel: length of each straight tunnel segment.
+  double segment_length = 20.0;  // NOLINT(readability-magic-numbers)
+};
+
+/// A primitive shape in a @c Scenario .
+struct ohmtools_API ScenarioShape
+{
+  /// Shape types.
+  enum Type : int
+  {
+    kBox,      ///< Axis aligned box spanning @c min_ext to @c max_ext .
+    kCylinder  ///< Z axis aligned cylinder inscribed in the XY extents of @c min_ext to @c max_ext .
+  };
+
+  /// Minimum extents of the shape bounds.
+  glm::dvec3 min_ext{ 0.0 };
+  /// Maximum extents of the shape bounds.
+  glm::dvec3 max_ext{ 0.0 };
+  /// The shape type.
+  Type type = kBox;
+  /// Carve this shape out of the solid shapes rather than adding solid space.
+  bool carve = false;
+};
+
+/// A point on a @c Scenario trajectory. See @c generateTrajectory() .
+struct ohmtools_API TrajectorySample
+{
+  double timestamp = 0;        ///< Sample time (seconds).
+  glm::dvec3 position{ 0.0 };  ///< Sensor position.
+};
+
+/// Lidar model used by @c generateRays() . Models a spinning multi-beam lidar with a vertical spin axis.
+struct ohmtools_API LidarParams
+{
+  /// Number of beams in each column, evenly spaced over the elevation range.
+  unsigned beam_count = 16;  // NOLINT(readability-magic-numbers)
+  /// Number of columns per revolution.
+  unsigned azimuth_samples = 1024;  // NOLINT(readability-magic-numbers)
+  /// Lowest beam elevation (degrees).
+  double min_elevation_deg = -15.0;  // NOLINT(readability-magic-numbers)
+  /// Highest beam elevation (degrees).
+  double max_elevation_deg = 15.0;  // NOLINT(readability-magic-numbers)
+  /// Revolutions per second.
+  double scan_rate = 10.0;  // NOLINT(readability-magic-numbers)
+  /// Maximum sensor range.
+  double max_range = 50.0;  // NOLINT(readability-magic-numbers)
+  /// Standard deviation of Gaussian noise added to the range of each return.
+  double range_noise = 0.0;
+  /// Include rays which do not return within @c max_range , ending at @c max_range . These rays are generally
+  /// integrated with @c kRffClippedEnd semantics so the end point is not a hit.
+  bool include_misses = false;
+  /// Random number seed for the range noise.
+  uint32_t seed = 0;
+};
+
+/// A procedural environment made of primitive shapes, used to generate synthetic maps and lidar data for tests and
+/// benchmarks without recorded data.
+///
+/// The environment is occupied where a point lies within any solid shape, and not within any carved shape. Queries
+/// test all shapes, so the cost is linear in the shape count, which remains small for the generated environments.
+/// All queries are read only and safe to call concurrently.
+class ohmtools_API Scenario
+{
+public:
+  /// Generate a procedural environment.
+  /// @param params Generation parameters.
+  /// @return The generated scenario.
+  static Scenario generate(const ScenarioParams &params);
+
+  /// Add a solid axis aligned box.
+  /// @param min_ext The box minimum extents.
+  /// @param max_ext The box maximum extents.
+  /// @param carve Carve the box out of the solid shapes instead.
+  void addBox(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext, bool carve = false);
+
+  /// Add a solid, Z axis aligned cylinder.
+  /// @param base_centre Centre of the cylinder base.
+  /// @param radius The cylinder radius.
+  /// @param height The cylinder height.
+  void addCylinder(const glm::dvec3 &base_centre, double radius, double height);
+
+  /// Access the scenario shapes.
+  /// @return The shapes.
+  inline const std::vector<ScenarioShape> &shapes() const { return shapes_; }
+
+  /// Access the collision free path through the environment, used to generate trajectories.
+  /// @return The path waypoints.
+  inline const std::vector<glm::dvec3> &path() const { return path_; }
+
+  /// Set the collision free path through the environment.
+  /// @param path The path waypoints.
+  inline void setPath(const std::vector<glm::dvec3> &path) { path_ = path; }
+
+  /// Query the minimum extents of the solid shapes.
+  /// @return The minimum extents.
+  inline const glm::dvec3 &minExtents() const { return min_ext_; }
+  /// Query the maximum extents of the solid shapes.
+  /// @return The maximum extents.
+  inline const glm::dvec3 &maxExtents() const { return max_ext_; }
+
+  /// Create a scenario containing only the shapes which overlap the given box. Used to accelerate queries over a
+  /// small volume. The path is not copied.
+  /// @param min_ext The box minimum extents.
+  /// @param max_ext The box maximum extents.
+  /// @return The overlapping subset of this scenario.
+  Scenario overlapping(const glm::dvec3 &min_ext, const glm::dvec3 &max_ext) const;
+
+  /// Test whether @p point is occupied.
+  /// @param point The point to test.
+  /// @return True if @p point lies in a solid shape and no carved shape.
+  bool occupied(const glm::dvec3 &point) const;
+
+  /// Cast a ray into the environment.
+  /// @param origin The ray origin.
+  /// @param dir The normalised ray direction.
+  /// @param max_range The maximum range to consider.
+  /// @param[out] range Set to the range of the first occupied point when there is a hit.
+  /// @return True if the ray hits occupied space within @p max_range .
+  bool raycast(const glm::dvec3 &origin, const glm::dvec3 &dir, double max_range, double *range) const;
+
+private:
+  void expandExtents(const ScenarioShape &shape);
+
+  std::vector<ScenarioShape> shapes_;
+  std::vector<glm::dvec3> path_;
+  glm::dvec3 min_ext_{ 0.0 };
+  glm::dvec3 max_ext_{ 0.0 };
+  bool has_solid_ = false;
+  bool has_carved_ = false;
+};
+
+/// Parse a @c ScenarioType from its name: "urban", "forest" or "tunnel".
+/// @param name The name to parse.
+/// @param[out] type Set to the parsed type on success.
+/// @return True on success.
+bool ohmtools_API parseScenarioType(const std::string &name, ScenarioType *type);
+
+/// Generate a constant speed trajectory along the @c Scenario::path() .
+/// @param scenario The scenario to generate a trajectory for.
+/// @param speed The travel speed (m/s).
+/// @param interval Time between trajectory samples (seconds).
+/// @param[out] trajectory Trajectory samples are appended here.
+/// @param start_time Timestamp of the first sample.
+/// @return The number of samples added.
+size_t ohmtools_API generateTrajectory(const Scenario &scenario, double speed, double interval,
+                                       std::vector<TrajectorySample> &trajectory, double start_time = 0);
+
+/// Generate synthetic lidar rays by sweeping a spinning lidar along @p trajectory and casting each beam into
+/// @p scenario .
+///
+/// The sensor position of each column is interpolated along the trajectory at the column time, so rays within a
+/// revolution are skewed as for a real sensor in motion. Rays are cast in parallel when built with
+/// @c OHM_FEATURE_THREADS and @p use_threads is set. Results are independent of threading as the noise for each ray is
+/// seeded from its index.
+///
+/// @param scenario The environment to scan.
+/// @param trajectory The sensor trajectory, in time order.
+/// @param lidar The sensor model.
+/// @param[out] rays Origin/sample pairs are appended here, in time order.
+/// @param[out] timestamps Optional per ray timestamps, appended here.
+/// @param use_threads Allow rays to be cast in parallel?
+/// @return The number of rays added.
+size_t ohmtools_API generateRays(const Scenario &scenario, const std::vector<TrajectorySample> &trajectory,
+                                 const LidarParams &lidar, std::vector<glm::dvec3> &rays,
+                                 std::vector<double> *timestamps = nullptr, bool use_threads = true);
+
+/// Write the ground truth occupancy of @p scenario into @p map .
+///
+/// Voxels with occupied centres are set to the @c OccupancyMap::occupancyThresholdValue() . With @p fill_free , all
+/// other voxels within the scenario extents are set to the @c OccupancyMap::missValue() , otherwise only the regions
+/// overlapping solid shapes are visited and free voxels are left unobserved. Regions are created up front then filled
+/// in parallel when built with @c OHM_FEATURE_THREADS and @p use_threads is set.
+///
+/// @param map The map to populate.
+/// @param scenario The scenario to voxelise.
+/// @param fill_free Write free space as well as occupied voxels?
+/// @param use_threads Allow regions to be filled in parallel?
+/// @return The number of occupied voxels written.
+size_t ohmtools_API populateMap(ohm::OccupancyMap &map, const Scenario &scenario, bool fill_free = false,
+                                bool use_threads = true);
+}  // namespace ohmgen
+
+#endif  // OHMTOOLS_OHMSCENARIO_H
@@ -29,6 +29,12 @@
 // Enable various validation tests throughout this library.
 //#cmakedefine OHM_FEATURE_THREADS
 
+// Octomap conversion available? See OhmOctomap.h
+#cmakedefine OHM_FEATURE_OCTOMAP
+
+// OpenVDB grid conversion available? See OhmVdb.h
+#cmakedefine OHM_FEATURE_OPENVDB
+
 #include "OhmConfig.h"
 
 #endif  // OHMTOOLSCONFIG_H
@@ -0,0 +1,424 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmVdb.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/Key.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapRegion.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/ParallelForEach.h>
+#include <ohm/VoxelOccupancy.h>
+#include <ohm/VoxelSpan.h>
+#include <ohm/VoxelTsdf.h>
+
+#include <openvdb/tree/ValueAccessor.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace ohmtools
+{
+namespace
+{
+using LeafNode = openvdb::FloatTree::LeafNodeType;
+
+/// Tolerance, in voxels, for aligning grid voxels with map voxels on import.
+const double kAlignmentTolerance = 1e-3;
+
+/// Resolve the map layer index for @p layer , or -1 if missing.
+int layerIndex(const ohm::OccupancyMap &map, VdbLayer layer)
+{
+  switch (layer)
+  {
+  case VdbLayer::kOccupancy:
+    return map.layout().occupancyLayer();
+  case VdbLayer::kTsdf:
+    return map.layout().layerIndex(ohm::default_layer::tsdfLayerName());
+  case VdbLayer::kClearance:
+    return map.layout().clearanceLayer();
+  default:
+    break;
+  }
+  return -1;
+}
+
+
+/// Calculate the grid background value for @p layer .
+float backgroundValue(const ohm::OccupancyMap &map, VdbLayer layer)
+{
+  switch (layer)
+  {
+  case VdbLayer::kTsdf:
+  {
+    ohm::TsdfOptions tsdf_options;
+    ohm::fromMapInfo(tsdf_options, map.mapInfo());
+    return tsdf_options.default_truncation_distance;
+  }
+  case VdbLayer::kClearance:
+    return -1.0f;
+  case VdbLayer::kOccupancy:
+  default:
+    break;
+  }
+  return 0.0f;
+}
+
+
+/// Floored integer division, rounding towards negative infinity.
+inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+
+/// Calculate the map wide index coordinate of the first voxel of the region at @p region_coord .
+inline glm::ivec3 regionVoxelBase(const glm::i16vec3 &region_coord, const glm::ivec3 &region_dim)
+{
+  return glm::ivec3(region_coord) * region_dim;
+}
+
+
+/// Export the voxels of @p layer_index from all regions of @p map into @p tree . The @p extract function selects the
+/// voxels to export: `bool(const T &voxel, float *value)` .
+template <typename T, typename Extract>
+void exportLayer(const ohm::OccupancyMap &map, int layer_index, openvdb::FloatTree &tree, Extract &&extract,
+                 bool use_threads)
+{
+  const float background = tree.background();
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  ohm::WorkerLocal<openvdb::FloatTree::Ptr> worker_trees(nullptr);
+
+  ohm::forEachVoxelSpan<T>(
+    map, layer_index,
+    [&worker_trees, &extract, background, region_dim](const ohm::VoxelSpan<const T> &span, unsigned worker_index)  //
+    {
+      openvdb::FloatTree::Ptr &worker_tree = worker_trees.local(worker_index);
+      if (!worker_tree)
+      {
+        worker_tree = std::make_shared<openvdb::FloatTree>(background);
+      }
+
+      // Populate the leaf nodes directly, only going through the accessor when moving to another leaf.
+      openvdb::FloatTree::Accessor accessor(*worker_tree);
+      LeafNode *leaf = nullptr;
+      const ohm::VoxelKeyDecoder &decoder = span.keyDecoder();
+      const glm::ivec3 base = regionVoxelBase(decoder.regionCoord(), region_dim);
+      float value = background;
+      for (size_t i = 0; i < span.size(); ++i)
+      {
+        if (!extract(span[i], &value))
+        {
+          continue;
+        }
+
+        const glm::u8vec3 local = decoder.localKey(i);
+        const openvdb::Coord ijk(base.x + local.x, base.y + local.y, base.z + local.z);
+        if (!leaf || leaf->origin() != (ijk & ~int(LeafNode::DIM - 1)))
+        {
+          leaf = accessor.touchLeaf(ijk);
+        }
+        leaf->setValueOn(LeafNode::coordToOffset(ijk), value);
+      }
+    },
+    use_threads);
+
+  // Regions are disjoint, but may share leaf nodes when the region dimensions are not a multiple of the leaf size.
+  for (openvdb::FloatTree::Ptr &worker_tree : worker_trees.items())
+  {
+    if (worker_tree)
+    {
+      tree.merge(*worker_tree, openvdb::MergePolicy::MERGE_ACTIVE_STATES);
+    }
+  }
+}
+
+
+/// Import the active voxels of @p tree into @p layer_index of the @p chunks . The grid index coordinate of a map voxel
+/// is its map wide index coordinate less @p offset . The @p assign function writes a grid value into a voxel:
+/// `void(T &voxel, float value)` .
+/// @return The number of voxels imported.
+template <typename T, typename Assign>
+size_t importLayer(ohm::OccupancyMap &map, int layer_index, const std::vector<const ohm::MapChunk *> &chunks,
+                   const openvdb::FloatTree &tree, const glm::ivec3 &offset, bool update_first_valid,
+                   Assign &&assign, bool use_threads)
+{
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  const uint64_t stamp = map.touch();
+  ohm::WorkerLocal<openvdb::FloatTree::ConstAccessor> accessors{ openvdb::FloatTree::ConstAccessor(tree) };
+  std::vector<size_t> region_counts(chunks.size(), 0u);
+
+  ohm::parallelForEachRegion(
+    chunks,
+    [&](const ohm::MapChunk &chunk, size_t region_index, unsigned worker_index)  //
+    {
+      // The map is mutable, so its chunks are too.
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+      ohm::MapChunk &target_chunk = const_cast<ohm::MapChunk &>(chunk);
+      ohm::VoxelSpan<T> span(&target_chunk, map, layer_index);
+      if (!span.isValid())
+      {
+        return;
+      }
+
+      openvdb::FloatTree::ConstAccessor &accessor = accessors.local(worker_index);
+      const ohm::VoxelKeyDecoder &decoder = span.keyDecoder();
+      const glm::ivec3 base = regionVoxelBase(decoder.regionCoord(), region_dim) - offset;
+      size_t count = 0;
+      float value = 0;
+      for (size_t i = 0; i < span.size(); ++i)
+      {
+        const glm::u8vec3 local = decoder.localKey(i);
+        if (!accessor.probeValue(openvdb::Coord(base.x + local.x, base.y + local.y, base.z + local.z), value))
+        {
+          continue;
+        }
+
+        assign(span[i], value);
+        if (update_first_valid)
+        {
+          target_chunk.updateFirstValid(local, region_dim);
+        }
+        ++count;
+      }
+
+      if (count)
+      {
+        span.touch(stamp);
+      }
+      region_counts[region_index] = count;
+    },
+    use_threads);
+
+  size_t total = 0;
+  for (size_t count : region_counts)
+  {
+    total += count;
+  }
+  return total;
+}
+
+
+/// Resolve the offset from grid index coordinates to map wide voxel index coordinates.
+/// @return False if the grid voxels do not align with the map voxels.
+bool resolveGridOffset(const ohm::OccupancyMap &map, const openvdb::FloatGrid &grid, glm::ivec3 *offset)
+{
+  const openvdb::math::Transform &transform = grid.transform();
+  if (!transform.isLinear())
+  {
+    return false;
+  }
+
+  // Each grid axis must step exactly one map voxel along the same map axis. This rejects rotation and mismatched
+  // voxel sizes.
+  const double resolution = map.resolution();
+  const openvdb::Vec3d grid_zero = transform.indexToWorld(openvdb::Coord(0, 0, 0));
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    openvdb::Coord step(0, 0, 0);
+    step[axis] = 1;
+    const openvdb::Vec3d delta = (transform.indexToWorld(step) - grid_zero) / resolution;
+    for (int i = 0; i < 3; ++i)
+    {
+      const double expected = (i == axis) ? 1.0 : 0.0;
+      if (std::abs(delta[i] - expected) > kAlignmentTolerance)
+      {
+        return false;
+      }
+    }
+  }
+
+  // Voxel centres must align.
+  const glm::dvec3 map_zero = map.voxelCentreGlobal(ohm::Key(glm::i16vec3(0), glm::u8vec3(0)));
+  for (int i = 0; i < 3; ++i)
+  {
+    const double voxel_offset = (grid_zero[i] - map_zero[i]) / resolution;
+    const double rounded = std::round(voxel_offset);
+    if (std::abs(voxel_offset - rounded) > kAlignmentTolerance)
+    {
+      return false;
+    }
+    (*offset)[i] = int(rounded);
+  }
+
+  return true;
+}
+
+
+/// Create the regions of @p map covering the active voxels of @p tree .
+void createRegions(ohm::OccupancyMap &map, const openvdb::FloatTree &tree, const glm::ivec3 &offset,
+                   std::vector<const ohm::MapChunk *> &chunks)
+{
+  const glm::ivec3 region_dim(map.regionVoxelDimensions());
+  const int region_min = std::numeric_limits<int16_t>::min();
+  const int region_max = std::numeric_limits<int16_t>::max();
+  std::unordered_set<glm::i16vec3, ohm::MapRegion::Hash> region_keys;
+  glm::ivec3 last_region(0);
+  bool have_last = false;
+
+  for (auto leaf = tree.cbeginLeaf(); leaf; ++leaf)
+  {
+    for (auto iter = leaf->cbeginValueOn(); iter; ++iter)
+    {
+      const openvdb::Coord ijk = iter.getCoord();
+      const glm::ivec3 region(floorDiv(ijk.x() + offset.x, region_dim.x), floorDiv(ijk.y() + offset.y, region_dim.y),
+                              floorDiv(ijk.z() + offset.z, region_dim.z));
+      // Active voxels in a leaf are generally in the same region.
+      if (have_last && region == last_region)
+      {
+        continue;
+      }
+      last_region = region;
+      have_last = true;
+
+      if (glm::any(glm::lessThan(region, glm::ivec3(region_min))) ||
+          glm::any(glm::greaterThan(region, glm::ivec3(region_max))))
+      {
+        // Outside the addressable map.
+        continue;
+      }
+      region_keys.insert(glm::i16vec3(region));
+    }
+  }
+
+  chunks.clear();
+  chunks.reserve(region_keys.size());
+  for (const glm::i16vec3 &region_key : region_keys)
+  {
+    chunks.emplace_back(map.region(region_key, true));
+  }
+}
+}  // namespace
+
+
+openvdb::FloatGrid::Ptr exportVdbGrid(const ohm::OccupancyMap &map, VdbLayer layer, bool use_threads)
+{
+  const int layer_index = layerIndex(map, layer);
+  if (layer_index < 0)
+  {
+    return nullptr;
+  }
+
+  openvdb::FloatGrid::Ptr grid = openvdb::FloatGrid::create(backgroundValue(map, layer));
+  grid->setName(map.layout().layerPtr(layer_index)->name());
+
+  // Map the grid index coordinates to the map voxel centres.
+  openvdb::math::Transform::Ptr transform = openvdb::math::Transform::createLinearTransform(map.resolution());
+  const glm::dvec3 voxel_zero = map.voxelCentreGlobal(ohm::Key(glm::i16vec3(0), glm::u8vec3(0)));
+  transform->postTranslate(openvdb::Vec3d(voxel_zero.x, voxel_zero.y, voxel_zero.z));
+  grid->setTransform(transform);
+
+  switch (layer)
+  {
+  case VdbLayer::kOccupancy:
+    exportLayer<float>(
+      map, layer_index, grid->tree(),
+      [](const float &occupancy, float *value) {
+        *value = occupancy;
+        return occupancy != ohm::unobservedOccupancyValue();
+      },
+      use_threads);
+    break;
+  case VdbLayer::kTsdf:
+    grid->setGridClass(openvdb::GRID_LEVEL_SET);
+    exportLayer<ohm::VoxelTsdf>(
+      map, layer_index, grid->tree(),
+      [](const ohm::VoxelTsdf &tsdf, float *value) {
+        *value = tsdf.distance;
+        return tsdf.weight > 0;
+      },
+      use_threads);
+    break;
+  case VdbLayer::kClearance:
+    exportLayer<float>(
+      map, layer_index, grid->tree(),
+      [](const float &clearance, float *value) {
+        *value = clearance;
+        return clearance >= 0;
+      },
+      use_threads);
+    break;
+  default:
+    break;
+  }
+
+  return grid;
+}
+
+
+size_t importVdbGrid(ohm::OccupancyMap &map, const openvdb::FloatGrid &grid, VdbLayer layer, bool use_threads)
+{
+  glm::ivec3 offset(0);
+  if (!resolveGridOffset(map, grid, &offset))
+  {
+    return 0;
+  }
+
+  switch (layer)
+  {
+  case VdbLayer::kTsdf:
+    map.addLayer(ohm::default_layer::tsdfLayerName(), [](ohm::MapLayout &layout) { ohm::addTsdf(layout); });
+    break;
+  case VdbLayer::kClearance:
+    map.addLayer(ohm::default_layer::clearanceLayerName(), [](ohm::MapLayout &layout) { ohm::addClearance(layout); });
+    break;
+  case VdbLayer::kOccupancy:
+  default:
+    break;
+  }
+
+  const int layer_index = layerIndex(map, layer);
+  if (layer_index < 0)
+  {
+    return 0;
+  }
+
+  // Densify any active tiles so all active values are found in leaf nodes.
+  const openvdb::FloatTree *tree = &grid.tree();
+  openvdb::FloatTree::Ptr voxelised_tree;
+  if (tree->activeTileCount() > 0)
+  {
+    voxelised_tree = std::make_shared<openvdb::FloatTree>(*tree);
+    voxelised_tree->voxelizeActiveTiles();
+    tree = voxelised_tree.get();
+  }
+
+  // Create regions serially, then populate them in parallel.
+  std::vector<const ohm::MapChunk *> chunks;
+  createRegions(map, *tree, offset, chunks);
+
+  switch (layer)
+  {
+  case VdbLayer::kOccupancy:
+    return importLayer<float>(
+      map, layer_index, chunks, *tree, offset, true, [](float &occupancy, float value) { occupancy = value; },
+      use_threads);
+  case VdbLayer::kTsdf:
+    return importLayer<ohm::VoxelTsdf>(
+      map, layer_index, chunks, *tree, offset, false,
+      [](ohm::VoxelTsdf &tsdf, float value) {
+        tsdf.distance = value;
+        tsdf.weight = (tsdf.weight > 0) ? tsdf.weight : 1.0f;
+      },
+      use_threads);
+  case VdbLayer::kClearance:
+    return importLayer<float>(
+      map, layer_index, chunks, *tree, offset, false, [](float &clearance, float value) { clearance = value; },
+      use_threads);
+  default:
+    break;
+  }
+
+  return 0;
+}
+}  // namespace ohmtools
@@ -0,0 +1,69 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMTOOLS_OHMVDB_H
+#define OHMTOOLS_OHMVDB_H
+
+#include "OhmToolsConfig.h"
+
+#include <openvdb/openvdb.h>
+
+#include <cstddef>
+
+namespace ohm
+{
+class OccupancyMap;
+}  // namespace ohm
+
+namespace ohmtools
+{
+/// Identifies the @c ohm::OccupancyMap layer converted to or from an OpenVDB @c FloatGrid .
+enum class VdbLayer : unsigned
+{
+  /// The occupancy layer. Grid values are the occupancy log odds values. Only observed voxels are active and the
+  /// background is zero; a probability of 0.5.
+  kOccupancy,
+  /// The TSDF layer - see @c ohm::VoxelTsdf . Grid values are the signed distances of voxels with a non zero weight.
+  /// The background is the map's TSDF truncation distance and the grid is classed as a level set.
+  kTsdf,
+  /// The clearance layer. Grid values are the clearance of voxels with a known obstruction (non negative clearance).
+  /// The background is -1; no obstruction within the search range.
+  kClearance
+};
+
+/// Export a layer of @p map to an OpenVDB @c FloatGrid .
+///
+/// The grid uses a linear transform matching the map resolution and origin, so the grid voxel at index coordinate
+/// `ijk` covers the same space as the map voxel `ijk` voxels from the map origin. The map regions are converted in
+/// parallel - see @c ohm::parallelForEachRegion() - with each worker populating the leaf nodes of its own tree
+/// directly from the region voxel memory. The worker trees are then merged into the result.
+///
+/// OpenVDB must be initialised via @c openvdb::initialize() before reading or writing the grid to file.
+///
+/// @param map The map to export.
+/// @param layer The layer to export.
+/// @param use_threads Allow regions to be converted in parallel?
+/// @return The exported grid, named after the map layer, or null when @p map does not have the requested layer.
+openvdb::FloatGrid::Ptr ohmtools_API exportVdbGrid(const ohm::OccupancyMap &map, VdbLayer layer,
+                                                   bool use_threads = true);
+
+/// Import the active voxels of an OpenVDB @c FloatGrid into a layer of @p map . This is the inverse of
+/// @c exportVdbGrid() .
+///
+/// The grid must have a uniform voxel size matching the map resolution, with voxel centres aligned to the map voxel
+/// centres. Regions covering the active grid voxels are created as required, then populated in parallel. Inactive
+/// grid voxels leave the map voxels unchanged. The TSDF and clearance layers are added to @p map if missing, while
+/// imported TSDF voxels are given a unit weight unless already observed.
+///
+/// @param map The map to import into.
+/// @param grid The grid to import.
+/// @param layer The layer to import into.
+/// @param use_threads Allow regions to be populated in parallel?
+/// @return The number of voxels imported or zero when the grid is incompatible with @p map .
+size_t ohmtools_API importVdbGrid(ohm::OccupancyMap &map, const openvdb::FloatGrid &grid, VdbLayer layer,
+                                  bool use_threads = true);
+}  // namespace ohmtools
+
+#endif  // OHMTOOLS_OHMVDB_H
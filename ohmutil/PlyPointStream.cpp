@@ -281,6 +281,53 @@ void PlyPointStream::writePoint()
 }
 
 
+bool PlyPointStream::writePoints(const PlyPointBuffer &buffer)
+{
+  if (!isOpen() || buffer.pointByteSize() != pointByteSize())
+  {
+    return false;
+  }
+
+  out_->write(reinterpret_cast<const char *>(buffer.data()), std::streamsize(buffer.byteSize()));
+  point_count_ += buffer.pointCount();
+  return out_->good();
+}
+
+
+size_t PlyPointStream::pointByteSize() const
+{
+  size_t byte_size = 0;
+  for (const auto &property : properties_)
+  {
+    byte_size += typeSize(property.type);
+  }
+  return byte_size;
+}
+
+
+size_t PlyPointStream::typeSize(Type type)
+{
+  switch (type)
+  {
+  case Type::kInt8:
+  case Type::kUInt8:
+    return 1;
+  case Type::kInt16:
+  case Type::kUInt16:
+    return 2;
+  case Type::kInt32:
+  case Type::kUInt32:
+  case Type::kFloat32:
+    return 4;
+  case Type::kFloat64:
+    return 8;  // NOLINT(readability-magic-numbers)
+  default:
+    break;
+  }
+  return 0;
+}
+
+
 std::string PlyPointStream::typeName(Type type)
 {
   // Lint(KS): tried using an enum value for the array size, but that didn't work.
@@ -422,4 +469,52 @@ bool PlyPointStream::finalisePointCount()
   }
   return false;
 }
+
+
+PlyPointBuffer::PlyPointBuffer(const std::vector<PlyPointStream::Property> &properties)
+  : properties_(properties)
+{
+  offsets_.reserve(properties_.size());
+  for (const auto &property : properties_)
+  {
+    offsets_.emplace_back(point_byte_size_);
+    point_byte_size_ += PlyPointStream::typeSize(property.type);
+  }
+
+  const std::array<const char *, 3> position_names = { "x", "y", "z" };
+  for (size_t i = 0; i < position_names.size(); ++i)
+  {
+    const int index = propertyIndex(position_names[i]);
+    position_indices_[i] = (index >= 0 && properties_[index].type == PlyPointStream::Type::kFloat64) ? index : -1;
+  }
+}
+
+
+int PlyPointBuffer::propertyIndex(const std::string &name) const
+{
+  for (size_t i = 0; i < properties_.size(); ++i)
+  {
+    if (name == properties_[i].name)
+    {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+
+size_t PlyPointBuffer::addPoint()
+{
+  const size_t index = pointCount();
+  data_.resize(data_.size() + point_byte_size_, 0u);
+  return index;
+}
+
+
+bool PlyPointBuffer::setPointPosition(size_t point_index, const glm::dvec3 &pos)
+{
+  return setProperty(point_index, position_indices_[0], pos.x) &&
+         setProperty(point_index, position_indices_[1], pos.y) &&
+         setProperty(point_index, position_indices_[2], pos.z);
+}
 }  // namespace ohm
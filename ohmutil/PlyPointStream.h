@@ -10,13 +10,17 @@
 
 #include <glm/fwd.hpp>
 
+#include <array>
 #include <cinttypes>
+#include <cstring>
 #include <ostream>
 #include <string>
 #include <vector>
 
 namespace ohm
 {
+class PlyPointBuffer;
+
 /// A utility class for writing out a point cloud to PLY format. The cloud is written in a progressive, streaming
 /// fashion so has low memory overhead and can handle large clouds. This relies on using a @c std::ostream which
 /// supports seeking in order to patch the number of points in the correct location on completion.
@@ -48,6 +52,9 @@ namespace ohm
 ///   ply.close();
 /// }
 /// @endcode
+///
+/// For large clouds, points may instead be binary encoded into a @c PlyPointBuffer - possibly one per thread - and
+/// written in large blocks using @c writePoints() .
 class ohmutil_API PlyPointStream
 {
 public:
@@ -151,6 +158,21 @@ public:
   /// Write the current collected point data. Values which have not been set will retain their previous value.
   void writePoint();
 
+  /// Write a block of pre-encoded points with a single write call. The @p buffer must have been created with the same
+  /// @c properties() as this stream.
+  /// @param buffer The encoded points to write.
+  /// @return True on success, false if not open or when the @p buffer point layout does not match.
+  bool writePoints(const PlyPointBuffer &buffer);
+
+  /// Query the size of a single encoded point in bytes.
+  /// @return The byte size of one point, being the sum of the @c properties() type sizes.
+  size_t pointByteSize() const;
+
+  /// Query the byte size of a value of the given @p type .
+  /// @param type The type to query.
+  /// @return The byte size of @p type or zero for invalid types.
+  static size_t typeSize(Type type);
+
   /// Query the ply string name for @p type . This is written to the ply file as the property type.
   /// @param type The type to query.
   /// @return The ply type name for @p type
@@ -209,6 +231,90 @@ private:
   uint64_t point_count_ = 0;
   std::ostream::pos_type point_count_pos_ = -1;
 };
+
+
+/// A buffer of binary encoded points matching the layout written by a @c PlyPointStream . Points are encoded directly
+/// into a contiguous byte array, addressing properties by index rather than by name, to be written in a single block
+/// using @c PlyPointStream::writePoints() . Each buffer is independent, so separate buffers may be encoded
+/// concurrently.
+///
+/// @code
+/// ohm::PlyPointBuffer buffer(ply.properties());
+/// const int red = buffer.propertyIndex("red");
+/// for (const auto &point : points)
+/// {
+///   const size_t index = buffer.addPoint();
+///   buffer.setPointPosition(index, point.position);
+///   buffer.setProperty(index, red, point.red);
+/// }
+/// ply.writePoints(buffer);
+/// @endcode
+class ohmutil_API PlyPointBuffer
+{
+public:
+  /// Create a buffer for the given point @p properties .
+  /// @param properties The point properties. Must match the target @c PlyPointStream::properties() .
+  explicit PlyPointBuffer(const std::vector<PlyPointStream::Property> &properties);
+
+  /// Lookup the index of the property with the given @p name .
+  /// @param name The property name.
+  /// @return The property index or -1 if not found.
+  int propertyIndex(const std::string &name) const;
+
+  /// Query the size of a single encoded point in bytes.
+  /// @return The point byte size.
+  inline size_t pointByteSize() const { return point_byte_size_; }
+  /// Query the number of points in the buffer.
+  /// @return The point count.
+  inline size_t pointCount() const { return (point_byte_size_) ? data_.size() / point_byte_size_ : 0; }
+  /// Access the encoded point data.
+  /// @return The encoded data, @c pointCount() times @c pointByteSize() bytes.
+  inline const uint8_t *data() const { return data_.data(); }
+  /// Query the number of bytes in the @c data() array.
+  /// @return The encoded data byte size.
+  inline size_t byteSize() const { return data_.size(); }
+
+  /// Reserve space for @p point_count points.
+  /// @param point_count The number of points to reserve space for.
+  inline void reserve(size_t point_count) { data_.reserve(point_count * point_byte_size_); }
+  /// Clear the buffer, retaining the allocation.
+  inline void clear() { data_.clear(); }
+
+  /// Add a new, zero initialised point to the buffer.
+  /// @return The index of the new point.
+  size_t addPoint();
+
+  /// Set the "x", "y", "z" properties for the point at @p point_index . Properties must be @c kFloat64 .
+  /// @param point_index Index of the point to modify.
+  /// @param pos The position to write.
+  /// @return True if the position properties are available.
+  bool setPointPosition(size_t point_index, const glm::dvec3 &pos);
+
+  /// Set the value of a property for the point at @p point_index . Only the byte size of @p T is validated against the
+  /// property type.
+  /// @param point_index Index of the point to modify.
+  /// @param property_index Index of the property to set. See @c propertyIndex() .
+  /// @param value The value to write.
+  /// @return True if the property index is valid and the value size matches the property type.
+  template <typename T>
+  inline bool setProperty(size_t point_index, int property_index, T value)
+  {
+    if (property_index < 0 || size_t(property_index) >= properties_.size() ||
+        PlyPointStream::typeSize(properties_[property_index].type) != sizeof(T))
+    {
+      return false;
+    }
+    memcpy(&data_[point_index * point_byte_size_ + offsets_[property_index]], &value, sizeof(T));
+    return true;
+  }
+
+private:
+  std::vector<PlyPointStream::Property> properties_;
+  std::vector<size_t> offsets_;
+  std::vector<uint8_t> data_;
+  size_t point_byte_size_ = 0;
+  std::array<int, 3> position_indices_{ -1, -1, -1 };
+};
 }  // namespace ohm
 
 #endif  // OHMUTILPLYPOINTSTREAM_H
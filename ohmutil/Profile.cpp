@@ -9,18 +9,18 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <mutex>
+#include <sstream>
 #include <thread>
 #include <vector>
 
 #include <logutil/LogUtil.h>
 
-#ifdef OHM_FEATURE_THREADS
-#include <tbb/tbb_thread.h>
-#endif  // OHM_FEATURE_THREADS
-
 namespace ohm
 {
 struct ProfileRecord
@@ -67,10 +67,26 @@ struct ProfileScope  // NOLINT(cppcoreguidelines-pro-type-member-init)
   {}
 };
 
+/// A completed marker scope recorded in the timeline.
+struct ProfileEvent
+{
+  const char *name;
+  ProfileClock::time_point start_time;
+  ProfileClock::time_point end_time;
+};
+
 struct ThreadRecords
 {
+  std::thread::id thread_id;
+  unsigned thread_index = 0;
   ska::bytell_hash_map<std::string, ProfileRecord *> records;
   std::vector<ProfileScope> marker_stack;
+  /// Timeline ring buffer. Only written by the owning thread. Allocation is guarded by @c ProfileDetail::mutex .
+  std::unique_ptr<ProfileEvent[]> events;
+  /// Number of elements in @c events .
+  size_t event_capacity = 0;
+  /// Number of events recorded into @c events including overwritten events.
+  std::atomic<uint64_t> event_count{ 0 };
 
   ~ThreadRecords()
   {
@@ -81,50 +97,106 @@ struct ThreadRecords
   }
 };
 
-#ifdef OHM_FEATURE_THREADS
-void compareThreadIds(std::thread::id stdId, tbb::internal::tbb_thread_v3::id tbbId)
-{
-  static bool once = true;
-  if (once && *(unsigned *)&stdId != *(unsigned *)&tbbId)
-  {
-    once = false;
-  }
-}
-#endif  // OHM_FEATURE_THREADS
-
 struct ProfileDetail
 {
   std::mutex mutex;
-  std::vector<std::pair<std::thread::id, ThreadRecords>> thread_records;
+  std::vector<std::unique_ptr<ThreadRecords>> thread_records;
   std::atomic_bool reported;
   std::atomic_bool suppress_report;
+  /// Timeline capacity per thread. Zero when disabled.
+  std::atomic<size_t> timeline_capacity{ 0 };
+  /// Time reference for timeline event timestamps.
+  const ProfileClock::time_point epoch = ProfileClock::now();
+  /// Unique id used to validate the thread local @c ThreadRecords cache.
+  const uint64_t id;
+  /// File to write a Chrome trace to on destruction. Set from @c OHM_PROFILE_TRACE .
+  std::string trace_path;
 
   inline ProfileDetail()
     : reported(true)
     , suppress_report(false)
+    , id(nextId())
   {}
 
+  static uint64_t nextId()
+  {
+    static std::atomic<uint64_t> next_id(1u);
+    return next_id++;
+  }
 
   inline ThreadRecords &getCurrentThreadRecords()
   {
+    // Cache the records for the last profile used on this thread, so the common case takes no lock.
+    thread_local uint64_t cached_id = 0;
+    thread_local ThreadRecords *cached_records = nullptr;
+    if (cached_id == id)
+    {
+      return *cached_records;
+    }
+
     std::unique_lock<std::mutex> guard(mutex);
-#ifdef OHM_FEATURE_THREADS
-    // compareThreadIds(std::this_thread::get_id(), tbb::this_tbb_thread::get_id());
-#endif  // OHM_FEATURE_THREADS
+    ThreadRecords *records = nullptr;
     for (auto &search : thread_records)
     {
-      if (search.first == std::this_thread::get_id())
+      if (search->thread_id == std::this_thread::get_id())
       {
-        return search.second;
+        records = search.get();
+        break;
       }
     }
 
-    thread_records.emplace_back(std::make_pair(std::this_thread::get_id(), ThreadRecords()));
-    return thread_records.back().second;
+    if (!records)
+    {
+      thread_records.emplace_back(std::make_unique<ThreadRecords>());
+      records = thread_records.back().get();
+      records->thread_id = std::this_thread::get_id();
+      records->thread_index = unsigned(thread_records.size());
+    }
+
+    cached_id = id;
+    cached_records = records;
+    return *records;
+  }
+
+  /// Record a completed scope in the timeline for the current thread.
+  inline void recordEvent(ThreadRecords &records, const ProfileScope &scope, const ProfileClock::time_point &end_time)
+  {
+    const size_t capacity = timeline_capacity.load(std::memory_order_relaxed);
+    if (capacity == 0)
+    {
+      return;
+    }
+
+    if (records.event_capacity != capacity)
+    {
+      std::unique_lock<std::mutex> guard(mutex);
+      records.events = std::make_unique<ProfileEvent[]>(capacity);
+      records.event_capacity = capacity;
+      records.event_count = 0;
+    }
+
+    const uint64_t event_index = records.event_count.load(std::memory_order_relaxed);
+    records.events[event_index % records.event_capacity] = ProfileEvent{ scope.name, scope.start_time, end_time };
+    records.event_count.store(event_index + 1, std::memory_order_release);
   }
 };
 
 
+void writeJsonString(std::ostream &o, const char *str)
+{
+  o << '"';
+  for (const char *ch = str; *ch; ++ch)
+  {
+    if (*ch == '"' || *ch == '\\')
+    {
+      o << '\\';
+    }
+    o << *ch;
+  }
+  o << '"';
+}
+
+
 void showReport(std::ostream &o, const ProfileRecord &record, const ThreadRecords &thread_records, int level = 0)
 {
   std::string indent(level * 2, ' ');
@@ -151,9 +223,9 @@ void showReport(std::ostream &o, const ProfileRecord &record, const ThreadRecord
 }
 
 
-void showReport(std::ostream &o, const std::thread::id &thread_id, const ThreadRecords &records)
+void showReport(std::ostream &o, const ThreadRecords &records)
 {
-  o << "thread " << thread_id << '\n';
+  o << "thread " << records.thread_id << '\n';
   for (auto &&record : records.records)
   {
     if (record.second->parent_name == nullptr)
@@ -167,12 +239,23 @@ void showReport(std::ostream &o, const std::thread::id &thread_id, const ThreadR
 
 Profile::Profile()
   : imp_(std::make_unique<ProfileDetail>())
-{}
+{
+  const char *trace_path = std::getenv("OHM_PROFILE_TRACE");
+  if (trace_path && *trace_path)
+  {
+    imp_->trace_path = trace_path;
+    enableTimeline();
+  }
+}
 
 
 Profile::~Profile()
 {
   report();
+  if (!imp_->trace_path.empty())
+  {
+    writeChromeTrace(imp_->trace_path);
+  }
 }
 
 
@@ -211,8 +294,10 @@ void Profile::pop()
 
   imp_->reported = false;
   const ProfileScope popped_scope = records.marker_stack.back();
-  const auto elapsed = ProfileClock::now() - popped_scope.start_time;
+  const auto end_time = ProfileClock::now();
+  const auto elapsed = end_time - popped_scope.start_time;
   records.marker_stack.pop_back();
+  imp_->recordEvent(records, popped_scope, end_time);
 
   // Key on the parent scope plus the popped scope.
   const char *parent_name = (!records.marker_stack.empty()) ? records.marker_stack.back().name : "";
@@ -254,7 +339,7 @@ void Profile::report(std::ostream *optr)
 
     for (auto &&records : imp_->thread_records)
     {
-      showReport(out, records.first, records.second);
+      showReport(out, *records);
     }
 
     out << "----------------------------------------\n";
@@ -275,4 +360,75 @@ bool Profile::reportSupressed() const
 {
   return imp_->suppress_report;
 }
+
+
+void Profile::enableTimeline(size_t capacity)
+{
+  imp_->timeline_capacity = capacity;
+}
+
+
+size_t Profile::timelineCapacity() const
+{
+  return imp_->timeline_capacity;
+}
+
+
+void Profile::writeChromeTrace(std::ostream &out) const
+{
+  std::unique_lock<std::mutex> guard(imp_->mutex);
+  const auto timestamp_us = [this](const ProfileClock::time_point &time) {
+    return std::chrono::duration<double, std::micro>(time - imp_->epoch).count();
+  };
+
+  const auto precision = out.precision();
+  const auto flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (const auto &records : imp_->thread_records)
+  {
+    std::ostringstream thread_name;
+    thread_name << "thread " << records->thread_id;
+    out << ((first) ? "\n" : ",\n");
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << records->thread_index
+        << ",\"args\":{\"name\":";
+    writeJsonString(out, thread_name.str().c_str());
+    out << "}}";
+    first = false;
+
+    if (!records->events)
+    {
+      continue;
+    }
+
+    const uint64_t event_count = records->event_count.load(std::memory_order_acquire);
+    const uint64_t first_event = (event_count > records->event_capacity) ? event_count - records->event_capacity : 0;
+    for (uint64_t i = first_event; i < event_count; ++i)
+    {
+      const ProfileEvent &event = records->events[i % records->event_capacity];
+      out << ",\n{\"name\":";
+      writeJsonString(out, event.name);
+      out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << records->thread_index
+          << ",\"ts\":" << timestamp_us(event.start_time)
+          << ",\"dur\":" << std::chrono::duration<double, std::micro>(event.end_time - event.start_time).count()
+          << '}';
+    }
+  }
+  out << "\n]}\n";
+  out.precision(precision);
+  out.flags(flags);
+}
+
+
+bool Profile::writeChromeTrace(const std::string &path) const
+{
+  std::ofstream out(path.c_str());
+  if (!out.is_open())
+  {
+    return false;
+  }
+  writeChromeTrace(out);
+  return out.good();
+}
 }  // namespace ohm
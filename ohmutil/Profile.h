@@ -11,8 +11,10 @@
 #include "ProfileMarker.h"
 
 #include <chrono>
+#include <cstddef>
 #include <iosfwd>
 #include <memory>
+#include <string>
 
 namespace ohm
 {
@@ -57,6 +59,17 @@ struct ProfileDetail;
 /// ----------------------------------------
 /// ----------------------------------------
 /// @endcode
+///
+/// @par Timeline
+/// The profile can also record a timeline of individual marker scopes by calling @c enableTimeline() . Each thread
+/// records its completed scopes into its own fixed size ring buffer without locking, overwriting the oldest events once
+/// full. The timeline is exported using @c writeChromeTrace() in the Chrome trace event JSON format, which can be
+/// viewed in `chrome://tracing` or Perfetto and imported into Tracy using its `import-chrome` tool. The timeline may
+/// also be enabled by setting the @c OHM_PROFILE_TRACE environment variable to a file name, in which case the Chrome
+/// trace is written to that file when the @c Profile is destroyed.
+///
+/// Profiling is compiled out unless @c PROFILING is defined to a non-zero value - see @c OHM_PROFILE - in which case
+/// the @c PROFILE() macros have no cost.
 class ohmutil_API Profile
 {
 public:
@@ -99,6 +112,33 @@ public:
   /// @return True when reporting has been suppressed.
   bool reportSupressed() const;
 
+  /// Default number of timeline events retained per thread by @c enableTimeline() .
+  static constexpr size_t kDefaultTimelineCapacity = 1u << 16u;
+
+  /// Enable or disable recording the marker timeline for @c writeChromeTrace() .
+  ///
+  /// The per thread ring buffers are allocated on the next @c pop() from each thread. Changing the capacity discards
+  /// previously recorded events.
+  ///
+  /// @param capacity Number of events to retain per thread. Zero disables the timeline.
+  void enableTimeline(size_t capacity = kDefaultTimelineCapacity);
+
+  /// Query the per thread timeline capacity.
+  /// @return The number of events retained per thread, or zero when the timeline is disabled.
+  size_t timelineCapacity() const;
+
+  /// Write the timeline recorded since @c enableTimeline() in the Chrome trace event JSON format.
+  ///
+  /// This may be called while markers are being recorded, but events being overwritten in a full ring buffer during
+  /// the export may be reported with inconsistent timing.
+  ///
+  /// @param out The stream to write to.
+  void writeChromeTrace(std::ostream &out) const;
+  /// @overload
+  /// @param path The file to write to.
+  /// @return True if the file was successfully written.
+  bool writeChromeTrace(const std::string &path) const;
+
 private:
   std::unique_ptr<ProfileDetail> imp_;
 };
@@ -136,15 +176,18 @@ private:
 #define PROFILE_RESTART_IF(name, cond) __profile##name.restart(cond);
 
 #define PROFILE2(name, prof) ohm::ProfileMarker __profile##name(#name, prof);
-#define PROFILE_IF2(name, cond) ohm::ProfileMarker __profile##name(#name, prof, cond);
+#define PROFILE_IF2(name, prof, cond) ohm::ProfileMarker __profile##name(#name, prof, cond);
 
 #else  // PROFILING
 
 #define PROFILE(name)
-#define PROFILE_IF(name)
+#define PROFILE_IF(name, cond)
 #define PROFILE_END(name)
 #define PROFILE_RESTART(name)
-#define PROFILE_RESTART_IF(name)
+#define PROFILE_RESTART_IF(name, cond)
+
+#define PROFILE2(name, prof)
+#define PROFILE_IF2(name, prof, cond)
 
 #endif  // PROFILING
 
@@ -0,0 +1,132 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "TrajectoryIndex.h"
+
+#include <algorithm>
+
+namespace ohm
+{
+TrajectoryIndex::TrajectoryIndex() = default;
+
+
+TrajectoryIndex::~TrajectoryIndex() = default;
+
+
+void TrajectoryIndex::clear()
+{
+  times_.clear();
+  positions_.clear();
+  rotations_.clear();
+  buckets_.clear();
+  bucket_scale_ = 0;
+}
+
+
+void TrajectoryIndex::reserve(size_t count)
+{
+  times_.reserve(count);
+  positions_.reserve(count);
+  rotations_.reserve(count);
+}
+
+
+bool TrajectoryIndex::add(double time, const glm::dvec3 &position, const glm::dquat &rotation)
+{
+  if (!times_.empty() && time < times_.back())
+  {
+    return false;
+  }
+
+  times_.emplace_back(time);
+  positions_.emplace_back(position);
+  rotations_.emplace_back(rotation);
+  buckets_.clear();
+  return true;
+}
+
+
+void TrajectoryIndex::buildIndex(size_t bucket_count)
+{
+  buckets_.clear();
+  bucket_scale_ = 0;
+  if (times_.empty())
+  {
+    return;
+  }
+
+  bucket_count = std::max<size_t>((bucket_count) ? bucket_count : times_.size(), 1u);
+  const double duration = times_.back() - times_.front();
+  bucket_scale_ = (duration > 0) ? double(bucket_count) / duration : 0.0;
+  if (bucket_scale_ == 0)
+  {
+    bucket_count = 1;
+  }
+
+  // Progressively find the segment containing each bucket start time.
+  const size_t last_segment = (times_.size() > 1) ? times_.size() - 2 : 0;
+  buckets_.resize(bucket_count + 1);
+  size_t segment = 0;
+  for (size_t b = 0; b < bucket_count; ++b)
+  {
+    const double bucket_start = (bucket_scale_ > 0) ? times_.front() + double(b) / bucket_scale_ : times_.front();
+    while (segment < last_segment && times_[segment + 1] <= bucket_start)
+    {
+      ++segment;
+    }
+    buckets_[b] = segment;
+  }
+  buckets_[bucket_count] = last_segment;
+}
+
+
+size_t TrajectoryIndex::findSegment(double time) const
+{
+  ensureIndex();
+  if (times_.size() < 3)
+  {
+    return 0;
+  }
+
+  const size_t bucket_count = buckets_.size() - 1;
+  const double bucket_offset = std::min((time - times_.front()) * bucket_scale_, double(bucket_count - 1));
+  const size_t bucket = (bucket_offset > 0) ? size_t(bucket_offset) : 0;
+
+  // Search the segments overlapping the bucket for the first pose after time, then step back one.
+  const size_t first = buckets_[bucket];
+  const size_t last = buckets_[bucket + 1] + 2;
+  const auto after = std::upper_bound(times_.begin() + first, times_.begin() + std::min(last, times_.size()), time);
+  const size_t index = size_t(std::max<std::ptrdiff_t>(after - times_.begin() - 1, 0));
+  return std::min(index, times_.size() - 2);
+}
+
+
+bool TrajectoryIndex::pose(double time, glm::dvec3 &position, glm::dquat *rotation) const
+{
+  if (times_.size() < 2 || time < times_.front() || time > times_.back())
+  {
+    return false;
+  }
+
+  const size_t segment = findSegment(time);
+  const double duration = times_[segment + 1] - times_[segment];
+  const double t = (duration > 0) ? std::max(0.0, std::min((time - times_[segment]) / duration, 1.0)) : 0.0;
+  position = positions_[segment] + t * (positions_[segment + 1] - positions_[segment]);
+  if (rotation)
+  {
+    *rotation = glm::slerp(rotations_[segment], rotations_[segment + 1], t);
+  }
+  return true;
+}
+
+
+void TrajectoryIndex::ensureIndex() const
+{
+  if (!indexed())
+  {
+    const_cast<TrajectoryIndex *>(this)->buildIndex();
+  }
+}
+}  // namespace ohm
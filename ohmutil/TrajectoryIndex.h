@@ -0,0 +1,117 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMUTIL_TRAJECTORYINDEX_H
+#define OHMUTIL_TRAJECTORYINDEX_H
+
+#include "OhmUtilExport.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace ohm
+{
+/// An indexed store of timestamped trajectory poses supporting constant time pose lookup for arbitrary timestamps.
+///
+/// Poses are stored in a structure of arrays layout - @c times() , @c positions() and @c rotations() - which may be
+/// passed directly to array based consumers such as @c GpuTransformSamples::transform() . Poses must be added in
+/// non decreasing time order.
+///
+/// Lookup uses uniform time buckets built by @c buildIndex() . Each bucket records the first segment overlapping the
+/// bucket, so a lookup is a bucket calculation followed by a search over the few segments within the bucket. Unlike a
+/// progressive trajectory cursor, the lookup cost does not depend on the order of the queried timestamps and @c pose()
+/// is safe to call concurrently once the index is built.
+///
+/// Positions are linearly interpolated between poses while rotations use spherical linear interpolation.
+class ohmutil_API TrajectoryIndex
+{
+public:
+  /// Constructor.
+  TrajectoryIndex();
+  /// Destructor.
+  ~TrajectoryIndex();
+
+  /// Clear all poses and the index.
+  void clear();
+
+  /// Reserve space for @p count poses.
+  /// @param count The number of poses to reserve.
+  void reserve(size_t count);
+
+  /// Add a pose. Invalidates the index until @c buildIndex() is called.
+  /// @param time The pose timestamp. Must not be less than the last pose time.
+  /// @param position The pose position.
+  /// @param rotation The pose rotation.
+  /// @return False if @p time is out of order, in which case the pose is not added.
+  bool add(double time, const glm::dvec3 &position, const glm::dquat &rotation = glm::dquat(1, 0, 0, 0));
+
+  /// Build the lookup index to cover the added poses. Called automatically on the first lookup if required, but
+  /// should be called explicitly before concurrent lookups.
+  /// @param bucket_count Number of time buckets. Zero selects one bucket per pose.
+  void buildIndex(size_t bucket_count = 0);
+
+  /// Has the index been built for the current poses?
+  /// @return True if the index is valid.
+  inline bool indexed() const { return !buckets_.empty() || times_.empty(); }
+
+  /// Query the number of poses.
+  /// @return The pose count.
+  inline size_t count() const { return times_.size(); }
+  /// Check if there are no poses.
+  /// @return True if empty.
+  inline bool empty() const { return times_.empty(); }
+
+  /// Access the pose timestamps array.
+  /// @return The @c count() pose times.
+  inline const double *times() const { return times_.data(); }
+  /// Access the pose positions array.
+  /// @return The @c count() pose positions.
+  inline const glm::dvec3 *positions() const { return positions_.data(); }
+  /// Access the pose rotations array.
+  /// @return The @c count() pose rotations.
+  inline const glm::dquat *rotations() const { return rotations_.data(); }
+
+  /// Query the first pose time.
+  /// @return The start time or zero when empty.
+  inline double startTime() const { return (!times_.empty()) ? times_.front() : 0.0; }
+  /// Query the last pose time.
+  /// @return The end time or zero when empty.
+  inline double endTime() const { return (!times_.empty()) ? times_.back() : 0.0; }
+
+  /// Find the index of the segment starting at pose @c i and ending at pose @c i+1 which contains @p time .
+  /// @param time The query time, which must be within [ @c startTime() , @c endTime() ].
+  /// @return The segment index. Zero with fewer than two poses.
+  size_t findSegment(double time) const;
+
+  /// Interpolate the pose at @p time .
+  /// @param time The query time.
+  /// @param[out] position Set to the interpolated position on success.
+  /// @param[out] rotation Optionally set to the interpolated rotation on success.
+  /// @return False if @p time is outside [ @c startTime() , @c endTime() ], or there are fewer than two poses.
+  bool pose(double time, glm::dvec3 &position, glm::dquat *rotation = nullptr) const;
+
+  /// @overload
+  inline bool pose(double time, glm::dvec3 &position, glm::dquat &rotation) const
+  {
+    return pose(time, position, &rotation);
+  }
+
+private:
+  /// Build the index if it is out of date. Only for a single threaded context.
+  void ensureIndex() const;
+
+  std::vector<double> times_;
+  std::vector<glm::dvec3> positions_;
+  std::vector<glm::dquat> rotations_;
+  /// First segment for each time bucket. Has one additional entry bounding the last bucket.
+  mutable std::vector<size_t> buckets_;
+  double bucket_scale_ = 0;
+};
+}  // namespace ohm
+
+#endif  // OHMUTIL_TRAJECTORYINDEX_H
@@ -13,6 +13,9 @@
 #endif  // _MSC_VER
 // Internal stream support.
 #include "pdal/PointStream.h"
+#if SLAMIO_HAVE_PDAL_PARALLEL
+#include "pdal/ParallelPointReader.h"
+#endif  // SLAMIO_HAVE_PDAL_PARALLEL
 #endif  // SLAMIO_HAVE_PDAL_STREAMS
 
 #include <pdal/Options.hpp>
@@ -23,6 +26,8 @@
 #include <pdal/io/LasReader.hpp>
 #endif  // SLAMIO_HAVE_PDAL_STREAMS
 
+#include <algorithm>
+
 namespace
 {
 const size_t kCloudStreamBufferSize = 10000u;
@@ -38,11 +43,15 @@ std::string getFileExtension(const std::string &file)
   return "";
 }
 
-slamio::PointCloudReaderPdal::PdalReaderPtr createReader(pdal::StageFactory &factory, const std::string &file_name)
+/// Maximum default number of threads used to decode LAS/LAZ files.
+const unsigned kMaxDefaultThreadCount = 4u;
+
+slamio::PointCloudReaderPdal::PdalReaderPtr createReader(pdal::StageFactory &factory, const std::string &file_name,
+                                                         const pdal::Options &extra_options = pdal::Options())
 {
   const std::string ext = getFileExtension(file_name);
   std::string reader_type;
-  pdal::Options options;
+  pdal::Options options = extra_options;
 
   reader_type = ext;
 
@@ -184,6 +193,7 @@ namespace slamio
 {
 PointCloudReaderPdal::PointCloudReaderPdal()
   : pdal_factory_(std::make_unique<pdal::StageFactory>())
+  , thread_count_(std::max(1u, std::min(std::thread::hardware_concurrency(), kMaxDefaultThreadCount)))
 {}
 
 PointCloudReaderPdal::~PointCloudReaderPdal()
@@ -191,6 +201,16 @@ PointCloudReaderPdal::~PointCloudReaderPdal()
   close();
 }
 
+void PointCloudReaderPdal::setThreadCount(unsigned thread_count)
+{
+  thread_count_ = std::max(1u, thread_count);
+}
+
+unsigned PointCloudReaderPdal::threadCount() const
+{
+  return thread_count_;
+}
+
 DataChannel PointCloudReaderPdal::availableChannels() const
 {
   return available_channels_;
@@ -327,6 +347,24 @@ bool PointCloudReaderPdal::open(const char *filename)
   }
 
 #if SLAMIO_HAVE_PDAL_STREAMS
+#if SLAMIO_HAVE_PDAL_PARALLEL
+  const std::string ext = getFileExtension(filename);
+  if (thread_count_ > 1 && (ext == "las" || ext == "laz") && point_count_ > kParallelBlockSize)
+  {
+    // Decode blocks in parallel using a reader per block. The initial reader is only used to resolve the channels.
+    const std::string file_name = filename;
+    const auto block_reader = [file_name](pdal::StageFactory &factory, uint64_t start, uint64_t count) {
+      pdal::Options options;
+      options.add("start", start);
+      options.add("count", count);
+      return createReader(factory, file_name, options);
+    };
+    parallel_reader_ = std::make_unique<ParallelPointReader>(block_reader, point_count_, required, thread_count_,
+                                                             kParallelBlockSize);
+    return true;
+  }
+#endif  // SLAMIO_HAVE_PDAL_PARALLEL
+
   sample_thread_ = std::thread([this]() {  //
     cloud_reader_->execute(*point_stream_);
     point_stream_->markLoadComplete();
@@ -339,6 +377,10 @@ bool PointCloudReaderPdal::open(const char *filename)
 void PointCloudReaderPdal::close()
 {
 #if SLAMIO_HAVE_PDAL_STREAMS
+#if SLAMIO_HAVE_PDAL_PARALLEL
+  // Aborts and joins the worker threads.
+  parallel_reader_.reset();
+#endif  // SLAMIO_HAVE_PDAL_PARALLEL
   if (point_stream_)
   {
     point_stream_->abort();
@@ -380,6 +422,13 @@ uint64_t PointCloudReaderPdal::pointCount() const
 bool PointCloudReaderPdal::readNext(CloudPoint &point)
 {
 #if SLAMIO_HAVE_PDAL_STREAMS
+#if SLAMIO_HAVE_PDAL_PARALLEL
+  if (parallel_reader_)
+  {
+    return parallel_reader_->nextPoint(point);
+  }
+#endif  // SLAMIO_HAVE_PDAL_PARALLEL
+
   // FIXME: Should really use a condition variable in nextPoint() rather than busy wait.
   bool have_read = point_stream_->nextPoint(point);
   while (!point_stream_->done() && !have_read)
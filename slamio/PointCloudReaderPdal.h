@@ -19,6 +19,7 @@
 
 namespace slamio
 {
+class ParallelPointReader;
 class PointStream;
 
 /// A point cloud loader which uses PDAL to load files. Requires PDAL 1.7 as it aims to support streaming via a
@@ -28,12 +29,26 @@ class PointStream;
 ///
 /// Note: streaming cannot be interrupted once started. This means that the program cannot exit until file loading
 /// has completed.
+///
+/// LAS/LAZ files may be decoded in parallel when built with PDAL 2.2+ (`SLAMIO_HAVE_PDAL_PARALLEL`). The file is split
+/// into blocks of @c kParallelBlockSize points, each loaded by a separate PDAL reader on one of @c threadCount()
+/// worker threads. Points are still presented in file order - see @c ParallelPointReader .
 class slamio_API PointCloudReaderPdal : public PointCloudReader
 {
 public:
+  /// Number of points in each block when decoding in parallel. A multiple of the default LAZ chunk size.
+  static constexpr uint64_t kParallelBlockSize = 500000u;
+
   PointCloudReaderPdal();
   ~PointCloudReaderPdal();
 
+  /// Set the number of threads used to decode LAS/LAZ files. Must be called before @c open() .
+  /// @param thread_count The number of decoding threads. Zero or one disables parallel decoding.
+  void setThreadCount(unsigned thread_count);
+  /// Query the number of threads used to decode LAS/LAZ files. Defaults to the hardware concurrency, up to 4.
+  /// @return The decoding thread count.
+  unsigned threadCount() const;
+
   DataChannel availableChannels() const override;
   DataChannel desiredChannels() const override;
   void setDesiredChannels(DataChannel channels) override;
@@ -70,6 +85,9 @@ private:
   PdalReaderPtr cloud_reader_;
 #if SLAMIO_HAVE_PDAL_STREAMS
   std::unique_ptr<PointStream> point_stream_;
+#if SLAMIO_HAVE_PDAL_PARALLEL
+  std::unique_ptr<ParallelPointReader> parallel_reader_;
+#endif  // SLAMIO_HAVE_PDAL_PARALLEL
 #else   // SLAMIO_HAVE_PDAL_STREAMS
   std::unique_ptr<pdal::PointTable> point_table_;
   pdal::PointViewPtr samples_view_;
@@ -79,6 +97,7 @@ private:
   pdal::point_count_t point_count_ = 0;
   DataChannel available_channels_ = DataChannel::None;
   DataChannel desired_channels_ = DataChannel::None;
+  unsigned thread_count_ = 1;
   std::thread sample_thread_;
 };
 }  // namespace slamio
@@ -0,0 +1,322 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "PointCloudReaderRayCloud.h"
+
+#include "private/MappedFile.h"
+#include "private/RayCloudFormat.h"
+
+#if SLAMIO_HAVE_LZ4
+#include <lz4.h>
+#endif  // SLAMIO_HAVE_LZ4
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace slamio
+{
+struct PointCloudReaderRayCloudDetail
+{
+  MappedFile file;
+  raycloud::FileHeader header;
+  std::vector<raycloud::ChunkEntry> chunks;
+  /// Decompression buffer for the current chunk.
+  std::vector<uint8_t> chunk_buffer;
+  /// Channel data for the current chunk. Not necessarily aligned.
+  const uint8_t *origins = nullptr;
+  const uint8_t *samples = nullptr;
+  const uint8_t *timestamps = nullptr;
+  const uint8_t *intensities = nullptr;
+  const uint8_t *return_numbers = nullptr;
+  /// Index of the currently decoded chunk or @c chunks.size() when none is decoded.
+  size_t chunk_index = 0;
+  /// Index of the next ray to read.
+  uint64_t next_ray = 0;
+  DataChannel desired_channels = DataChannel::None;
+
+  void resetChunk()
+  {
+    chunk_index = chunks.size();
+    origins = samples = timestamps = intensities = return_numbers = nullptr;
+  }
+
+  /// Decode chunk @p index , setting the channel pointers.
+  bool decodeChunk(size_t index)
+  {
+    if (index == chunk_index)
+    {
+      return true;
+    }
+
+    resetChunk();
+    if (index >= chunks.size())
+    {
+      return false;
+    }
+
+    const raycloud::ChunkEntry &chunk = chunks[index];
+    const size_t byte_size = raycloud::chunkByteSize(chunk.ray_count);
+    const uint8_t *data = file.data() + chunk.offset;
+    if (chunk.encoding == raycloud::kEncodingLz4)
+    {
+#if SLAMIO_HAVE_LZ4
+      chunk_buffer.resize(byte_size);
+      const int decoded =
+        LZ4_decompress_safe(reinterpret_cast<const char *>(data), reinterpret_cast<char *>(chunk_buffer.data()),
+                            int(chunk.stored_size), int(byte_size));
+      if (decoded != int(byte_size))
+      {
+        return false;
+      }
+      data = chunk_buffer.data();
+#else   // SLAMIO_HAVE_LZ4
+      // Compressed data not supported in this build.
+      return false;
+#endif  // SLAMIO_HAVE_LZ4
+    }
+    else if (chunk.encoding != raycloud::kEncodingRaw || chunk.stored_size != byte_size)
+    {
+      return false;
+    }
+
+    origins = data;
+    samples = origins + chunk.ray_count * sizeof(glm::dvec3);
+    timestamps = samples + chunk.ray_count * sizeof(glm::dvec3);
+    intensities = timestamps + chunk.ray_count * sizeof(double);
+    return_numbers = intensities + chunk.ray_count * sizeof(float);
+    chunk_index = index;
+    return true;
+  }
+
+  /// Does chunk @p index contain the ray at @p ray_index ?
+  bool containsRay(size_t index, uint64_t ray_index) const
+  {
+    return index < chunks.size() && chunks[index].first_ray <= ray_index &&
+           ray_index < chunks[index].first_ray + chunks[index].ray_count;
+  }
+
+  /// Find the index of the chunk containing @p ray_index .
+  size_t chunkForRay(uint64_t ray_index) const
+  {
+    const auto iter = std::upper_bound(
+      chunks.begin(), chunks.end(), ray_index,
+      [](uint64_t ray, const raycloud::ChunkEntry &chunk) { return ray < chunk.first_ray + chunk.ray_count; });
+    return size_t(std::distance(chunks.begin(), iter));
+  }
+
+  /// Validate the header and chunk table against the file size.
+  bool validate()
+  {
+    if (file.size() < sizeof(header))
+    {
+      return false;
+    }
+
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.marker != raycloud::kMarker || header.version > raycloud::kVersion ||
+        header.chunk_table_offset < sizeof(header) ||
+        header.chunk_table_offset + uint64_t(header.chunk_count) * sizeof(raycloud::ChunkEntry) > file.size())
+    {
+      return false;
+    }
+
+    chunks.resize(header.chunk_count);
+    if (!chunks.empty())
+    {
+      memcpy(chunks.data(), file.data() + header.chunk_table_offset, chunks.size() * sizeof(raycloud::ChunkEntry));
+    }
+
+    uint64_t ray_count = 0;
+    for (const auto &chunk : chunks)
+    {
+      if (chunk.first_ray != ray_count || chunk.offset + chunk.stored_size > header.chunk_table_offset)
+      {
+        return false;
+      }
+      ray_count += chunk.ray_count;
+    }
+
+    return ray_count == header.ray_count;
+  }
+};
+
+
+PointCloudReaderRayCloud::PointCloudReaderRayCloud()
+  : imp_(std::make_unique<PointCloudReaderRayCloudDetail>())
+{}
+PointCloudReaderRayCloud::~PointCloudReaderRayCloud()
+{
+  close();
+}
+
+
+DataChannel PointCloudReaderRayCloud::availableChannels() const
+{
+  return DataChannel::Position | DataChannel::Normal | DataChannel::Time | DataChannel::Intensity |
+         DataChannel::ReturnNumber;
+}
+
+DataChannel PointCloudReaderRayCloud::desiredChannels() const
+{
+  return imp_->desired_channels;
+}
+
+void PointCloudReaderRayCloud::setDesiredChannels(DataChannel channels)
+{
+  imp_->desired_channels = channels;
+}
+
+bool PointCloudReaderRayCloud::isOpen()
+{
+  return imp_->file.isOpen();
+}
+
+bool PointCloudReaderRayCloud::open(const char *filename)
+{
+  close();
+
+  // Random access is supported, so don't hint sequential reads.
+  if (!imp_->file.open(filename, false) || !imp_->validate())
+  {
+    close();
+    return false;
+  }
+
+  imp_->resetChunk();
+  imp_->next_ray = 0;
+
+  if (imp_->desired_channels == DataChannel::None)
+  {
+    imp_->desired_channels = availableChannels();
+  }
+
+  return true;
+}
+
+void PointCloudReaderRayCloud::close()
+{
+  imp_->file.close();
+  imp_->header = raycloud::FileHeader{};
+  imp_->chunks.clear();
+  imp_->chunk_buffer.clear();
+  imp_->resetChunk();
+  imp_->next_ray = 0;
+  imp_->desired_channels = DataChannel::None;
+}
+
+bool PointCloudReaderRayCloud::streaming() const
+{
+  return false;
+}
+
+uint64_t PointCloudReaderRayCloud::pointCount() const
+{
+  return imp_->header.ray_count;
+}
+
+bool PointCloudReaderRayCloud::readNext(CloudPoint &point)
+{
+  return readChunk(&point, 1) == 1;
+}
+
+uint64_t PointCloudReaderRayCloud::readChunk(CloudPoint *point, uint64_t count)
+{
+  PointCloudReaderRayCloudDetail &imp = *imp_;
+  uint64_t read_count = 0;
+  while (read_count < count && imp.next_ray < imp.header.ray_count)
+  {
+    const size_t chunk_index = (imp.containsRay(imp.chunk_index, imp.next_ray)) ? imp.chunk_index :
+                                                                                   imp.chunkForRay(imp.next_ray);
+    if (!imp.decodeChunk(chunk_index))
+    {
+      break;
+    }
+
+    const raycloud::ChunkEntry &chunk = imp.chunks[chunk_index];
+    const size_t first = size_t(imp.next_ray - chunk.first_ray);
+    const size_t chunk_read = size_t(std::min<uint64_t>(count - read_count, chunk.ray_count - first));
+    for (size_t i = first; i < first + chunk_read; ++i)
+    {
+      CloudPoint &pt = point[read_count++];
+      glm::dvec3 origin;
+      memcpy(&origin, imp.origins + i * sizeof(glm::dvec3), sizeof(origin));
+      memcpy(&pt.position, imp.samples + i * sizeof(glm::dvec3), sizeof(pt.position));
+      memcpy(&pt.timestamp, imp.timestamps + i * sizeof(double), sizeof(pt.timestamp));
+      memcpy(&pt.intensity, imp.intensities + i * sizeof(float), sizeof(pt.intensity));
+      pt.return_number = imp.return_numbers[i];
+      pt.normal = origin - pt.position;
+      pt.colour = glm::vec4(1.0f);
+    }
+    imp.next_ray += chunk_read;
+  }
+
+  return read_count;
+}
+
+
+bool PointCloudReaderRayCloud::timeRange(double &time_min, double &time_max) const
+{
+  if (!imp_->file.isOpen())
+  {
+    return false;
+  }
+  time_min = imp_->header.time_min;
+  time_max = imp_->header.time_max;
+  return true;
+}
+
+
+bool PointCloudReaderRayCloud::seekRay(uint64_t ray_index)
+{
+  if (!imp_->file.isOpen() || ray_index > imp_->header.ray_count)
+  {
+    return false;
+  }
+  imp_->next_ray = ray_index;
+  return true;
+}
+
+
+bool PointCloudReaderRayCloud::seekTime(double timestamp)
+{
+  PointCloudReaderRayCloudDetail &imp = *imp_;
+  if (!imp.file.isOpen())
+  {
+    return false;
+  }
+
+  // Find the first chunk which may contain the timestamp, then scan the chunk timestamps.
+  auto iter = std::lower_bound(imp.chunks.begin(), imp.chunks.end(), timestamp,
+                               [](const raycloud::ChunkEntry &chunk, double time) { return chunk.time_max < time; });
+  for (; iter != imp.chunks.end(); ++iter)
+  {
+    const size_t chunk_index = size_t(std::distance(imp.chunks.begin(), iter));
+    if (!imp.decodeChunk(chunk_index))
+    {
+      return false;
+    }
+
+    for (uint32_t i = 0; i < iter->ray_count; ++i)
+    {
+      double ray_time;
+      memcpy(&ray_time, imp.timestamps + i * sizeof(double), sizeof(ray_time));
+      if (ray_time >= timestamp)
+      {
+        imp.next_ray = iter->first_ray + i;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+uint64_t PointCloudReaderRayCloud::tell() const
+{
+  return imp_->next_ray;
+}
+}  // namespace slamio
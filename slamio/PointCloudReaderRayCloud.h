@@ -0,0 +1,73 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_POINTCLOUDREADERRAYCLOUD_H_
+#define SLAMIO_POINTCLOUDREADERRAYCLOUD_H_
+
+#include "SlamIOConfig.h"
+
+#include "PointCloudReader.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace slamio
+{
+struct PointCloudReaderRayCloudDetail;
+
+/// Reader for the native binary ray cloud format (`.rcb`) written by @c RayCloudWriter .
+///
+/// The file is memory mapped and decoded one chunk at a time. Points are presented as ray cloud points: the
+/// @c CloudPoint::position is the ray sample and the @c CloudPoint::normal is the vector from the sample back to the
+/// ray origin.
+///
+/// Unlike the text readers the point count is known on open and the reader supports random access by ray index or
+/// timestamp via the chunk table.
+class slamio_API PointCloudReaderRayCloud : public PointCloudReader
+{
+public:
+  PointCloudReaderRayCloud();
+  ~PointCloudReaderRayCloud();
+
+  DataChannel availableChannels() const override;
+  DataChannel desiredChannels() const override;
+  void setDesiredChannels(DataChannel channels) override;
+
+  bool isOpen() override;
+  bool open(const char *filename) override;
+  void close() override;
+
+  bool streaming() const override;
+
+  uint64_t pointCount() const override;
+  bool readNext(CloudPoint &point) override;
+  uint64_t readChunk(CloudPoint *point, uint64_t count) override;
+
+  /// Query the timestamp range of the file.
+  /// @param[out] time_min Set to the minimum ray timestamp.
+  /// @param[out] time_max Set to the maximum ray timestamp.
+  /// @return False if no file is open.
+  bool timeRange(double &time_min, double &time_max) const;
+
+  /// Seek such that the next ray read is the ray at index @p ray_index .
+  /// @param ray_index The ray index to seek to. Seeking to @c pointCount() ends reading.
+  /// @return False if not open or @p ray_index is out of range.
+  bool seekRay(uint64_t ray_index);
+
+  /// Seek to the first ray with a timestamp not less than @p timestamp . Exact when rays were written in time order.
+  /// @param timestamp The target timestamp.
+  /// @return False if not open or no ray is at or after @p timestamp .
+  bool seekTime(double timestamp);
+
+  /// Query the index of the next ray to be read.
+  /// @return The next ray index.
+  uint64_t tell() const;
+
+private:
+  std::unique_ptr<PointCloudReaderRayCloudDetail> imp_;
+};
+}  // namespace slamio
+
+#endif  // SLAMIO_POINTCLOUDREADERRAYCLOUD_H_
@@ -5,9 +5,36 @@
 // Author: Kazys Stepanas
 #include "PointCloudReaderTraj.h"
 
+#include "private/MappedTextFile.h"
+#include "private/TextParse.h"
+
 namespace slamio
 {
-PointCloudReaderTraj::PointCloudReaderTraj() = default;
+namespace
+{
+/// Line parser for @c MappedTextFile::readPoints() . Parses `time x y z`, ignoring additional fields.
+struct TrajLineParser
+{
+  bool operator()(const char *cursor, const char *end, CloudPoint &point) const
+  {
+    double *values[] = { &point.timestamp, &point.position.x, &point.position.y, &point.position.z };
+    for (double *value : values)
+    {
+      cursor = text::skipDelimiters(cursor, end);
+      if (!text::parseDouble(cursor, end, *value))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+}  // namespace
+
+
+PointCloudReaderTraj::PointCloudReaderTraj()
+  : file_(std::make_unique<MappedTextFile>())
+{}
 PointCloudReaderTraj::~PointCloudReaderTraj()
 {
   close();
@@ -31,27 +58,27 @@ void PointCloudReaderTraj::setDesiredChannels(DataChannel channels)
 
 bool PointCloudReaderTraj::isOpen()
 {
-  return file_in_.is_open();
+  return file_->isOpen();
 }
 
 bool PointCloudReaderTraj::open(const char *filename)
 {
   close();
-  file_in_.open(filename, std::ios::binary);
-
-  if (!file_in_.is_open())
+  if (!file_->open(filename))
   {
     close();
     return false;
   }
 
   // Try read the first data line. It may be valid or it may be headings.
-  CloudPoint point;
-  auto reset_pos = file_in_.tellg();
-  if (!readNext(point))
+  const char *line_begin = nullptr;
+  const char *line_end = nullptr;
+  CloudPoint point{};
+  const char *reset_pos = file_->cursor();
+  if (!file_->nextLine(line_begin, line_end) || !TrajLineParser()(line_begin, line_end, point))
   {
-    reset_pos = file_in_.tellg();
-    if (!readNext(point))
+    reset_pos = file_->cursor();
+    if (!file_->nextLine(line_begin, line_end) || !TrajLineParser()(line_begin, line_end, point))
     {
       // Data not ok.
       close();
@@ -68,7 +95,7 @@ bool PointCloudReaderTraj::open(const char *filename)
   }
 
   // Reset to the first valid data line.
-  file_in_.seekg(reset_pos);
+  file_->setCursor(reset_pos);
 
   if (desired_channels_ == DataChannel::None)
   {
@@ -80,7 +107,7 @@ bool PointCloudReaderTraj::open(const char *filename)
 
 void PointCloudReaderTraj::close()
 {
-  file_in_.close();
+  file_->close();
   desired_channels_ = DataChannel::None;
 }
 
@@ -96,47 +123,11 @@ uint64_t PointCloudReaderTraj::pointCount() const
 
 bool PointCloudReaderTraj::readNext(CloudPoint &point)
 {
-  if (!eof_)
-  {
-    if (!std::getline(file_in_, data_line_))
-    {
-      // End of file.
-      eof_ = true;
-      return false;
-    }
-
-    // sscanf is far faster than using stream operators.
-#ifdef _MSC_VER
-    if (sscanf_s(data_line_.c_str(), "%lg %lg %lg %lg", &point.timestamp, &point.position.x, &point.position.y,
-                 &point.position.z) == 4)
-#else   // _MSC_VER
-    if (sscanf(data_line_.c_str(), "%lg %lg %lg %lg", &point.timestamp, &point.position.x, &point.position.y,
-               &point.position.z) == 4)
-#endif  // _MSC_VER
-    {
-      return true;
-    }
-  }
-
-  return false;
+  return readChunk(&point, 1) == 1;
 }
 
 uint64_t PointCloudReaderTraj::readChunk(CloudPoint *point, uint64_t count)
 {
-  uint64_t read_count = 0;
-
-  for (uint64_t i = 0; i < count; ++i)
-  {
-    if (readNext(point[i]))
-    {
-      ++read_count;
-    }
-    else
-    {
-      break;
-    }
-  }
-
-  return read_count;
+  return file_->readPoints(point, count, TrajLineParser());
 }
 }  // namespace slamio
@@ -10,17 +10,13 @@
 
 #include "PointCloudReader.h"
 
-#include <fstream>
+#include <cstdint>
 #include <memory>
-#include <string>
-
-namespace miniply
-{
-class PLYReader;
-}
 
 namespace slamio
 {
+class MappedTextFile;
+
 /// Text file trajectory reader.
 ///
 /// Text file format assumptions:
@@ -29,6 +25,8 @@ namespace slamio
 /// - Data line format is : `time x y z <additional_fields>`
 /// - Data in a line are space delimited
 /// - @c `<additional_fields>` are ignored
+///
+/// The file is memory mapped and parsed in line aligned blocks across multiple threads. See @c MappedTextFile .
 class slamio_API PointCloudReaderTraj : public PointCloudReader
 {
 public:
@@ -50,11 +48,7 @@ public:
   uint64_t readChunk(CloudPoint *point, uint64_t count) override;
 
 private:
-  using FilePtr = std::unique_ptr<FILE, int (*)(FILE *)>;
-
-  std::ifstream file_in_;
-  std::string data_line_;
-  bool eof_ = false;
+  std::unique_ptr<MappedTextFile> file_;
   DataChannel desired_channels_ = DataChannel::Position | DataChannel::Time;
 };
 }  // namespace slamio
@@ -5,13 +5,102 @@
 // Author: Kazys Stepanas
 #include "PointCloudReaderXyz.h"
 
+#include "private/MappedTextFile.h"
+#include "private/TextParse.h"
+
 #include <algorithm>
 #include <cctype>
 #include <sstream>
 
 namespace slamio
 {
-PointCloudReaderXyz::PointCloudReaderXyz() = default;
+namespace
+{
+/// @c CloudPoint data populated from a column. See @c PointCloudReaderXyz::column_targets_ .
+enum ColumnTarget : int8_t
+{
+  kCtIgnore = -1,
+  kCtTime,
+  kCtX,
+  kCtY,
+  kCtZ,
+  kCtNx,
+  kCtNy,
+  kCtNz,
+  kCtIntensity,
+  kCtReturnNumber
+};
+
+
+/// Line parser for @c MappedTextFile::readPoints() .
+struct XyzLineParser
+{
+  const std::vector<int8_t> &column_targets;
+
+  bool operator()(const char *cursor, const char *end, CloudPoint &point) const
+  {
+    double value = 0;
+    for (const int8_t target : column_targets)
+    {
+      cursor = text::skipDelimiters(cursor, end);
+      if (cursor == end)
+      {
+        return false;
+      }
+
+      if (target == kCtIgnore)
+      {
+        cursor = text::skipToken(cursor, end);
+        continue;
+      }
+
+      if (!text::parseDouble(cursor, end, value))
+      {
+        return false;
+      }
+
+      switch (target)
+      {
+      case kCtTime:
+        point.timestamp = value;
+        break;
+      case kCtX:
+        point.position.x = value;
+        break;
+      case kCtY:
+        point.position.y = value;
+        break;
+      case kCtZ:
+        point.position.z = value;
+        break;
+      case kCtNx:
+        point.normal.x = value;
+        break;
+      case kCtNy:
+        point.normal.y = value;
+        break;
+      case kCtNz:
+        point.normal.z = value;
+        break;
+      case kCtIntensity:
+        point.intensity = float(value);
+        break;
+      case kCtReturnNumber:
+        point.return_number = uint8_t(value);
+        break;
+      default:
+        break;
+      }
+    }
+    return true;
+  }
+};
+}  // namespace
+
+
+PointCloudReaderXyz::PointCloudReaderXyz()
+  : file_(std::make_unique<MappedTextFile>())
+{}
 PointCloudReaderXyz::~PointCloudReaderXyz()
 {
   close();
@@ -35,15 +124,13 @@ void PointCloudReaderXyz::setDesiredChannels(DataChannel channels)
 
 bool PointCloudReaderXyz::isOpen()
 {
-  return file_in_.is_open();
+  return file_->isOpen();
 }
 
 bool PointCloudReaderXyz::open(const char *filename)
 {
   close();
-  file_in_.open(filename, std::ios::binary);
-
-  if (!file_in_.is_open())
+  if (!file_->open(filename))
   {
     close();
     return false;
@@ -67,7 +154,7 @@ bool PointCloudReaderXyz::open(const char *filename)
 
 void PointCloudReaderXyz::close()
 {
-  file_in_.close();
+  file_->close();
   available_channels_ = DataChannel::None;
 }
 
@@ -83,53 +170,12 @@ uint64_t PointCloudReaderXyz::pointCount() const
 
 bool PointCloudReaderXyz::readNext(CloudPoint &point)
 {
-  if (!eof_)
-  {
-    if (!std::getline(file_in_, data_line_))
-    {
-      // End of file.
-      eof_ = true;
-      return false;
-    }
-
-    // sscanf is far faster than using stream operators, but the unknown number of data items on a line mandate streams
-    std::istringstream istr(data_line_);
-
-    for (auto &value : values_buffer_)
-    {
-      istr >> value;
-    }
-
-    if (!istr.fail())
-    {
-      point.timestamp = values_buffer_[time_index_];
-      point.position.x = values_buffer_[x_index_];
-      point.position.y = values_buffer_[y_index_];
-      point.position.z = values_buffer_[z_index_];
-      return true;
-    }
-  }
-
-  return false;
+  return readChunk(&point, 1) == 1;
 }
 
 uint64_t PointCloudReaderXyz::readChunk(CloudPoint *point, uint64_t count)
 {
-  uint64_t read_count = 0;
-
-  for (uint64_t i = 0; i < count; ++i)
-  {
-    if (readNext(point[i]))
-    {
-      ++read_count;
-    }
-    else
-    {
-      break;
-    }
-  }
-
-  return read_count;
+  return file_->readPoints(point, count, XyzLineParser{ column_targets_ });
 }
 
 
@@ -169,18 +215,16 @@ size_t headingIndex(const std::vector<std::string> &names, const std::vector<std
 
 bool PointCloudReaderXyz::readHeadings()
 {
-  if (!eof_)
+  const char *line_begin = nullptr;
+  const char *line_end = nullptr;
+  if (!file_->nextLine(line_begin, line_end))
   {
-    if (!std::getline(file_in_, data_line_))
-    {
-      // End of file.
-      eof_ = true;
-      return false;
-    }
+    // End of file.
+    return false;
   }
 
   // Parse headings.
-  std::istringstream istr(data_line_);
+  std::istringstream istr(std::string(line_begin, line_end));
   std::vector<std::string> headings;
   std::string token;
   while (!istr.fail())
@@ -253,7 +297,29 @@ bool PointCloudReaderXyz::readHeadings()
     required_values_count = std::max(required_values_count, return_number_index_ + 1);
   }
 
-  values_buffer_.resize(required_values_count);
+  column_targets_.clear();
+  column_targets_.resize(required_values_count, kCtIgnore);
+  const auto set_target = [this](size_t index, ColumnTarget target) {
+    if (index != heading_not_found)
+    {
+      column_targets_[index] = target;
+    }
+  };
+  set_target(time_index_, kCtTime);
+  if ((available_channels_ & DataChannel::Position) != DataChannel::None)
+  {
+    set_target(x_index_, kCtX);
+    set_target(y_index_, kCtY);
+    set_target(z_index_, kCtZ);
+  }
+  if ((available_channels_ & DataChannel::Normal) != DataChannel::None)
+  {
+    set_target(nx_index_, kCtNx);
+    set_target(ny_index_, kCtNy);
+    set_target(nz_index_, kCtNz);
+  }
+  set_target(intensity_index_, kCtIntensity);
+  set_target(return_number_index_, kCtReturnNumber);
 
   const DataChannel required_channels = DataChannel::Position | DataChannel::Time;
   return (available_channels_ & required_channels) == required_channels;
@@ -10,18 +10,15 @@
 
 #include "PointCloudReader.h"
 
-#include <fstream>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
-namespace miniply
-{
-class PLYReader;
-}
-
 namespace slamio
 {
+class MappedTextFile;
+
 /// XYZ point cloud text file reader.
 ///
 /// Text file format assumptions:
@@ -42,6 +39,8 @@ namespace slamio
 ///   - timestamp
 ///   - time
 /// - Data in a line are space delimited
+///
+/// The file is memory mapped and parsed in line aligned blocks across multiple threads. See @c MappedTextFile .
 class slamio_API PointCloudReaderXyz : public PointCloudReader
 {
 public:
@@ -63,16 +62,13 @@ public:
   uint64_t readChunk(CloudPoint *point, uint64_t count) override;
 
 private:
-  using FilePtr = std::unique_ptr<FILE, int (*)(FILE *)>;
-
   bool readHeadings();
 
-  std::ifstream file_in_;
-  std::string data_line_;
-  bool eof_ = false;
+  std::unique_ptr<MappedTextFile> file_;
   DataChannel desired_channels_ = DataChannel::Position | DataChannel::Time;
   DataChannel available_channels_ = DataChannel::None;
-  std::vector<double> values_buffer_;
+  /// Maps each column, up to the last column of interest, to the @c CloudPoint data it populates.
+  std::vector<int8_t> column_targets_;
   size_t time_index_ = ~0u;
   size_t x_index_ = ~0u;
   size_t y_index_ = ~0u;
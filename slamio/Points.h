@@ -24,6 +24,7 @@ struct CloudPoint
   glm::vec4 colour;     ///< Point colour (if available)
   float intensity;      ///< Point intensity value (if available)
   uint8_t return_number;  ///< Zero based, sample return number (if available). Primary return is 0, second 1, etc.
+  uint8_t sensor_index;   ///< Index of the sensor file which generated the point when merging multiple sensor files.
 };
 
 /// SLAM sample point. This is very similar to a point cloud sample, but has an @p origin point rather than a point
@@ -37,6 +38,7 @@ struct SamplePoint
   glm::vec4 colour;       ///< Sample colour (if available)
   float intensity;        ///< Sample intensity (if available)
   uint8_t return_number;  ///< Zero based, sample return number (if available). Primary return is 0, second 1, etc.
+  uint8_t sensor_index;   ///< Index of the sensor file which generated the sample when merging multiple sensor files.
 };
 
 inline void c2sPt(SamplePoint &sample, const CloudPoint &cloud)
@@ -0,0 +1,243 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "RayCloudWriter.h"
+
+#include "private/RayCloudFormat.h"
+
+#if SLAMIO_HAVE_LZ4
+#include <lz4.h>
+#endif  // SLAMIO_HAVE_LZ4
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace slamio
+{
+struct RayCloudWriterDetail
+{
+  FILE *file = nullptr;
+  raycloud::FileHeader header;
+  std::vector<raycloud::ChunkEntry> chunks;
+  std::vector<glm::dvec3> origins;
+  std::vector<glm::dvec3> samples;
+  std::vector<double> timestamps;
+  std::vector<float> intensities;
+  std::vector<uint8_t> return_numbers;
+  std::vector<uint8_t> chunk_buffer;
+  std::vector<uint8_t> compression_buffer;
+  uint64_t write_offset = 0;
+  unsigned chunk_size = RayCloudWriter::kDefaultChunkSize;
+  bool compress = true;
+  bool ok = true;
+
+  bool write(const void *data, size_t byte_count)
+  {
+    if (byte_count && fwrite(data, 1, byte_count, file) != byte_count)
+    {
+      ok = false;
+    }
+    write_offset += byte_count;
+    return ok;
+  }
+
+  template <typename T>
+  void append(const std::vector<T> &values)
+  {
+    const size_t byte_count = values.size() * sizeof(T);
+    const size_t offset = chunk_buffer.size();
+    chunk_buffer.resize(offset + byte_count);
+    if (byte_count)
+    {
+      memcpy(chunk_buffer.data() + offset, values.data(), byte_count);
+    }
+  }
+};
+
+
+RayCloudWriter::RayCloudWriter(unsigned chunk_size, bool compress)
+  : imp_(std::make_unique<RayCloudWriterDetail>())
+{
+  // Limit the chunk size so chunk byte sizes fit the LZ4 API.
+  const unsigned max_chunk_size = unsigned(std::numeric_limits<int>::max() / (2 * raycloud::kRayByteSize));
+  imp_->chunk_size = std::max(1u, std::min(chunk_size, max_chunk_size));
+  imp_->compress = compress && compressionAvailable();
+}
+
+
+RayCloudWriter::~RayCloudWriter()
+{
+  close();
+}
+
+
+bool RayCloudWriter::compressionAvailable()
+{
+#if SLAMIO_HAVE_LZ4
+  return true;
+#else   // SLAMIO_HAVE_LZ4
+  return false;
+#endif  // SLAMIO_HAVE_LZ4
+}
+
+
+unsigned RayCloudWriter::chunkSize() const
+{
+  return imp_->chunk_size;
+}
+
+
+bool RayCloudWriter::open(const char *filename)
+{
+  close();
+  imp_->file = fopen(filename, "wb");
+  if (!imp_->file)
+  {
+    return false;
+  }
+
+  imp_->header = raycloud::FileHeader{};
+  imp_->header.time_min = std::numeric_limits<double>::max();
+  imp_->header.time_max = std::numeric_limits<double>::lowest();
+  imp_->chunks.clear();
+  imp_->write_offset = 0;
+  imp_->ok = true;
+
+  // Write a placeholder header. Rewritten on close().
+  return imp_->write(&imp_->header, sizeof(imp_->header));
+}
+
+
+bool RayCloudWriter::isOpen() const
+{
+  return imp_->file != nullptr;
+}
+
+
+bool RayCloudWriter::close()
+{
+  if (!imp_->file)
+  {
+    return true;
+  }
+
+  flushChunk();
+
+  // Write the chunk table then finalise the header.
+  imp_->header.chunk_count = uint32_t(imp_->chunks.size());
+  imp_->header.chunk_table_offset = imp_->write_offset;
+  if (imp_->header.ray_count == 0)
+  {
+    imp_->header.time_min = imp_->header.time_max = 0;
+  }
+  imp_->write(imp_->chunks.data(), imp_->chunks.size() * sizeof(raycloud::ChunkEntry));
+
+  if (fseek(imp_->file, 0, SEEK_SET) != 0)
+  {
+    imp_->ok = false;
+  }
+  imp_->write(&imp_->header, sizeof(imp_->header));
+
+  if (fclose(imp_->file) != 0)
+  {
+    imp_->ok = false;
+  }
+  imp_->file = nullptr;
+  imp_->chunks.clear();
+  return imp_->ok;
+}
+
+
+bool RayCloudWriter::addRay(const glm::dvec3 &origin, const glm::dvec3 &sample, double timestamp, float intensity,
+                            uint8_t return_number)
+{
+  if (!imp_->file || !imp_->ok)
+  {
+    return false;
+  }
+
+  imp_->origins.emplace_back(origin);
+  imp_->samples.emplace_back(sample);
+  imp_->timestamps.emplace_back(timestamp);
+  imp_->intensities.emplace_back(intensity);
+  imp_->return_numbers.emplace_back(return_number);
+
+  if (imp_->timestamps.size() >= imp_->chunk_size)
+  {
+    return flushChunk();
+  }
+  return true;
+}
+
+
+uint64_t RayCloudWriter::rayCount() const
+{
+  return imp_->header.ray_count + imp_->timestamps.size();
+}
+
+
+bool RayCloudWriter::flushChunk()
+{
+  RayCloudWriterDetail &imp = *imp_;
+  if (imp.timestamps.empty())
+  {
+    return imp.ok;
+  }
+
+  raycloud::ChunkEntry chunk;
+  chunk.offset = imp.write_offset;
+  chunk.first_ray = imp.header.ray_count;
+  chunk.ray_count = uint32_t(imp.timestamps.size());
+  const auto time_range = std::minmax_element(imp.timestamps.begin(), imp.timestamps.end());
+  chunk.time_min = *time_range.first;
+  chunk.time_max = *time_range.second;
+
+  imp.chunk_buffer.clear();
+  imp.chunk_buffer.reserve(raycloud::chunkByteSize(chunk.ray_count));
+  imp.append(imp.origins);
+  imp.append(imp.samples);
+  imp.append(imp.timestamps);
+  imp.append(imp.intensities);
+  imp.append(imp.return_numbers);
+
+  const std::vector<uint8_t> *stored = &imp.chunk_buffer;
+#if SLAMIO_HAVE_LZ4
+  if (imp.compress)
+  {
+    const int source_size = int(imp.chunk_buffer.size());
+    imp.compression_buffer.resize(size_t(LZ4_compressBound(source_size)));
+    const int compressed_size =
+      LZ4_compress_default(reinterpret_cast<const char *>(imp.chunk_buffer.data()),
+                           reinterpret_cast<char *>(imp.compression_buffer.data()), source_size,
+                           int(imp.compression_buffer.size()));
+    // Store raw when compression does not help.
+    if (compressed_size > 0 && compressed_size < source_size)
+    {
+      imp.compression_buffer.resize(size_t(compressed_size));
+      stored = &imp.compression_buffer;
+      chunk.encoding = raycloud::kEncodingLz4;
+    }
+  }
+#endif  // SLAMIO_HAVE_LZ4
+
+  chunk.stored_size = stored->size();
+  imp.write(stored->data(), stored->size());
+
+  imp.chunks.emplace_back(chunk);
+  imp.header.ray_count += chunk.ray_count;
+  imp.header.time_min = std::min(imp.header.time_min, chunk.time_min);
+  imp.header.time_max = std::max(imp.header.time_max, chunk.time_max);
+
+  imp.origins.clear();
+  imp.samples.clear();
+  imp.timestamps.clear();
+  imp.intensities.clear();
+  imp.return_numbers.clear();
+  return imp.ok;
+}
+}  // namespace slamio
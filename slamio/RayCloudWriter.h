@@ -0,0 +1,96 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_RAYCLOUDWRITER_H_
+#define SLAMIO_RAYCLOUDWRITER_H_
+
+#include "SlamIOConfig.h"
+
+#include "Points.h"
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <memory>
+
+namespace slamio
+{
+struct RayCloudWriterDetail;
+
+/// Writes the native binary ray cloud format, using the `.rcb` extension, which is read by
+/// @c PointCloudReaderRayCloud .
+///
+/// The format is designed for fast replay of recorded or preprocessed data:
+/// - A 64 byte file header with the ray count, time range and the chunk table offset.
+/// - A sequence of chunks, each holding up to @c chunkSize() rays in structure of arrays layout: origins (3 doubles),
+///   samples (3 doubles), timestamps (double), intensities (float) then return numbers (uint8).
+/// - Chunks are optionally LZ4 compressed when LZ4 support is available.
+/// - A chunk table at the end of the file listing each chunk's offset, size, first ray index and time range, which
+///   supports seeking by time or ray index.
+///
+/// Data are written in little endian byte order. Rays should be added in time order for time based seeking to be
+/// exact.
+class slamio_API RayCloudWriter
+{
+public:
+  /// Default number of rays per chunk.
+  static constexpr unsigned kDefaultChunkSize = 65536u;
+
+  /// Constructor.
+  /// @param chunk_size Number of rays per chunk.
+  /// @param compress Compress chunks with LZ4? Ignored when @c compressionAvailable() is false.
+  explicit RayCloudWriter(unsigned chunk_size = kDefaultChunkSize, bool compress = true);
+  /// Destructor, calling @c close() .
+  ~RayCloudWriter();
+
+  /// Query whether LZ4 chunk compression is available in this build.
+  /// @return True if chunks may be compressed.
+  static bool compressionAvailable();
+
+  /// Query the number of rays per chunk.
+  /// @return The chunk size.
+  unsigned chunkSize() const;
+
+  /// Open @p filename for writing, truncating any existing file.
+  /// @param filename The file to write.
+  /// @return True on success.
+  bool open(const char *filename);
+
+  /// Is there an open file?
+  /// @return True if open.
+  bool isOpen() const;
+
+  /// Flush pending rays, write the chunk table and close the file. Safe to call when not open.
+  /// @return True if all data were successfully written.
+  bool close();
+
+  /// Add a ray.
+  /// @param origin The ray origin or sensor position.
+  /// @param sample The ray sample point.
+  /// @param timestamp The sample timestamp.
+  /// @param intensity The sample intensity.
+  /// @param return_number The sample return number.
+  /// @return False on a write failure or when not open.
+  bool addRay(const glm::dvec3 &origin, const glm::dvec3 &sample, double timestamp, float intensity = 0.0f,
+              uint8_t return_number = 0);
+
+  /// @overload
+  inline bool addRay(const SamplePoint &sample)
+  {
+    return addRay(sample.origin, sample.sample, sample.timestamp, sample.intensity, sample.return_number);
+  }
+
+  /// Query the number of rays added.
+  /// @return The ray count.
+  uint64_t rayCount() const;
+
+private:
+  bool flushChunk();
+
+  std::unique_ptr<RayCloudWriterDetail> imp_;
+};
+}  // namespace slamio
+
+#endif  // SLAMIO_RAYCLOUDWRITER_H_
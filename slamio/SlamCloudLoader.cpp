@@ -8,10 +8,17 @@
 #include "PointCloudReader.h"
 #include "SlamIO.h"
 
+#include "private/BoundedQueue.h"
+#include "private/MergedCloudReader.h"
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -19,25 +26,175 @@
 
 namespace
 {
-using Clock = std::chrono::high_resolution_clock;
+using Clock = std::chrono::steady_clock;
 }  // namespace
 
 namespace slamio
 {
+/// Real time replay statistics. The drop counts are updated by the replay thread, the remainder by the consumer.
+struct SlamCloudLoaderReplayStats
+{
+  SlamCloudLoader::RealTimeStats consumer;
+  double total_lag = 0;
+  std::atomic<uint64_t> dropped_batches{ 0 };
+  std::atomic<uint64_t> dropped_samples{ 0 };
+
+  void reset()
+  {
+    consumer = SlamCloudLoader::RealTimeStats();
+    total_lag = 0;
+    dropped_batches = 0;
+    dropped_samples = 0;
+  }
+};
+
+/// A batch of samples released by the real time replay stage.
+struct SlamCloudLoaderBatch
+{
+  std::vector<SamplePoint> samples;
+  /// Scheduled release time for the batch.
+  Clock::time_point release_time;
+};
+
+/// Background loading pipeline state. See @c SlamCloudLoader::enablePipeline() .
+struct SlamCloudLoaderPipeline
+{
+  /// Raw point chunks from the reader thread.
+  BoundedQueue<std::vector<CloudPoint>> cloud_chunks;
+  /// Converted sample chunks from the interpolation thread.
+  BoundedQueue<std::vector<SamplePoint>> sample_chunks;
+  /// Released batches from the real time replay thread.
+  BoundedQueue<SlamCloudLoaderBatch> replay_batches;
+  std::thread reader_thread;
+  std::thread interpolation_thread;
+  std::thread replay_thread;
+  /// Used to wake the replay thread when stopping.
+  std::mutex replay_lock;
+  std::condition_variable replay_wake;
+  bool stopping = false;
+  /// Real time replay enabled? The consumer collects from @c replay_batches rather than @c sample_chunks .
+  bool replay = false;
+  SlamCloudLoaderReplayStats *replay_stats = nullptr;
+  /// Chunk currently being consumed by @c SlamCloudLoader::nextSample() .
+  std::vector<SamplePoint> current;
+  size_t current_index = 0;
+
+  explicit SlamCloudLoaderPipeline(size_t queue_depth)
+    : cloud_chunks(queue_depth)
+    , sample_chunks(queue_depth)
+    , replay_batches(queue_depth)
+  {}
+
+  /// Fetch the next chunk into @c current , discarding the existing content.
+  bool nextChunk()
+  {
+    current_index = 0;
+    current.clear();
+    if (replay)
+    {
+      SlamCloudLoaderBatch batch;
+      while (replay_batches.pop(batch))
+      {
+        if (!batch.samples.empty())
+        {
+          std::swap(current, batch.samples);
+          SlamCloudLoader::RealTimeStats &stats = replay_stats->consumer;
+          stats.lag = std::max(0.0, std::chrono::duration<double>(Clock::now() - batch.release_time).count());
+          stats.max_lag = std::max(stats.max_lag, stats.lag);
+          replay_stats->total_lag += stats.lag;
+          ++stats.batches;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    while (sample_chunks.pop(current))
+    {
+      if (!current.empty())
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Wait until @p time unless stopping.
+  /// @return False if the pipeline is stopping.
+  bool waitUntil(const Clock::time_point &time)
+  {
+    std::unique_lock<std::mutex> guard(replay_lock);
+    return !replay_wake.wait_until(guard, time, [this]() { return stopping; });
+  }
+
+  /// Queue a replay @p batch applying the drop @p policy .
+  /// @return False if the pipeline has been stopped.
+  bool releaseBatch(SlamCloudLoaderBatch &&batch, SlamCloudLoader::DropPolicy policy)
+  {
+    switch (policy)
+    {
+    case SlamCloudLoader::DropPolicy::kDropOldest: {
+      SlamCloudLoaderBatch dropped;
+      while (!replay_batches.tryPush(std::move(batch)))
+      {
+        if (replay_batches.isClosed())
+        {
+          return false;
+        }
+        if (replay_batches.tryPop(dropped))
+        {
+          ++replay_stats->dropped_batches;
+          replay_stats->dropped_samples += dropped.samples.size();
+        }
+      }
+      return true;
+    }
+    case SlamCloudLoader::DropPolicy::kDropNewest:
+      if (!replay_batches.tryPush(std::move(batch)))
+      {
+        if (replay_batches.isClosed())
+        {
+          return false;
+        }
+        ++replay_stats->dropped_batches;
+        replay_stats->dropped_samples += batch.samples.size();
+      }
+      return true;
+    case SlamCloudLoader::DropPolicy::kBlock:
+    default:
+      return replay_batches.push(std::move(batch));
+    }
+  }
+};
+
+
 struct SlamCloudLoaderDetail
 {
   PointCloudReaderPtr sample_reader;
   PointCloudReaderPtr trajectory_reader;
 
-  CloudPoint trajectory_buffer[2] = {};
+  /// Trajectory poses loaded from the @c trajectory_reader .
+  ohm::TrajectoryIndex trajectory;
   glm::dvec3 trajectory_to_sensor_offset{};
+  /// Per sensor transforms, indexed by @c CloudPoint::sensor_index . Empty unless merging multiple sensor files.
+  std::vector<glm::dmat4> sensor_transforms;
 
   SamplePoint next_sample;
+  /// Previously converted sample. Only accessed by the conversion stage.
+  SamplePoint previous_sample;
+  bool have_previous_sample = false;
   uint64_t read_count = 0;
   uint64_t preload_index = 0;
 
-  Clock::time_point first_sample_read_time;
-  double first_sample_timestamp = -1.0;
+  std::unique_ptr<SlamCloudLoaderPipeline> pipeline;
+  size_t pipeline_chunk_size = SlamCloudLoader::kDefaultPipelineChunkSize;
+  size_t pipeline_queue_depth = SlamCloudLoader::kDefaultPipelineQueueDepth;
+  bool pipeline_enabled = false;
+
+  double real_time_rate = 1.0;
+  double real_time_batch_period = SlamCloudLoader::kDefaultRealTimeBatchPeriod;
+  SlamCloudLoader::DropPolicy real_time_drop_policy = SlamCloudLoader::DropPolicy::kBlock;
+  SlamCloudLoaderReplayStats replay_stats;
   bool ray_cloud = false;
   bool real_time_mode = false;
   bool infer_return_number = false;
@@ -132,31 +289,124 @@ bool SlamCloudLoader::returnNumberInference() const
 }
 
 
+void SlamCloudLoader::enablePipeline(bool enable)
+{
+  imp_->pipeline_enabled = enable;
+}
+
+
+bool SlamCloudLoader::pipelineEnabled() const
+{
+  return imp_->pipeline_enabled;
+}
+
+
+void SlamCloudLoader::setPipelineChunkSize(size_t chunk_size)
+{
+  imp_->pipeline_chunk_size = (chunk_size) ? chunk_size : kDefaultPipelineChunkSize;
+}
+
+
+size_t SlamCloudLoader::pipelineChunkSize() const
+{
+  return imp_->pipeline_chunk_size;
+}
+
+
+void SlamCloudLoader::setPipelineQueueDepth(size_t queue_depth)
+{
+  imp_->pipeline_queue_depth = (queue_depth) ? queue_depth : kDefaultPipelineQueueDepth;
+}
+
+
+size_t SlamCloudLoader::pipelineQueueDepth() const
+{
+  return imp_->pipeline_queue_depth;
+}
+
+
+void SlamCloudLoader::setRealTimeRate(double rate)
+{
+  imp_->real_time_rate = (rate > 0) ? rate : 1.0;
+}
+
+
+double SlamCloudLoader::realTimeRate() const
+{
+  return imp_->real_time_rate;
+}
+
+
+void SlamCloudLoader::setRealTimeBatchPeriod(double period)
+{
+  imp_->real_time_batch_period = (period > 0) ? period : kDefaultRealTimeBatchPeriod;
+}
+
+
+double SlamCloudLoader::realTimeBatchPeriod() const
+{
+  return imp_->real_time_batch_period;
+}
+
+
+void SlamCloudLoader::setRealTimeDropPolicy(DropPolicy policy)
+{
+  imp_->real_time_drop_policy = policy;
+}
+
+
+SlamCloudLoader::DropPolicy SlamCloudLoader::realTimeDropPolicy() const
+{
+  return imp_->real_time_drop_policy;
+}
+
+
+SlamCloudLoader::RealTimeStats SlamCloudLoader::realTimeStats() const
+{
+  RealTimeStats stats = imp_->replay_stats.consumer;
+  stats.dropped_batches = imp_->replay_stats.dropped_batches;
+  stats.dropped_samples = imp_->replay_stats.dropped_samples;
+  stats.mean_lag = (stats.batches) ? imp_->replay_stats.total_lag / double(stats.batches) : 0.0;
+  return stats;
+}
+
+
 bool SlamCloudLoader::openWithTrajectory(const char *sample_file_path, const char *trajectory_file_path)
 {
-  return open(sample_file_path, trajectory_file_path, false);
+  return open({ SensorInput{ sample_file_path } }, trajectory_file_path, false);
+}
+
+
+bool SlamCloudLoader::openMultiSensor(const std::vector<SensorInput> &inputs, const char *trajectory_file_path)
+{
+  return open(inputs, trajectory_file_path, false);
 }
 
 
 bool SlamCloudLoader::openPointCloud(const char *sample_file_path)
 {
-  return open(sample_file_path, nullptr, false);
+  return open({ SensorInput{ sample_file_path } }, nullptr, false);
 }
 
 
 bool SlamCloudLoader::openRayCloud(const char *sample_file_path)
 {
-  return open(sample_file_path, nullptr, true);
+  return open({ SensorInput{ sample_file_path } }, nullptr, true);
 }
 
 
 void SlamCloudLoader::close()
 {
+  // Stop the pipeline before releasing the readers it uses.
+  stopPipeline();
   imp_->sample_reader = nullptr;
   imp_->trajectory_reader = nullptr;
+  imp_->sensor_transforms.clear();
+  imp_->trajectory.clear();
   imp_->read_count = 0;
   imp_->preload_index = 0;
-  imp_->first_sample_timestamp = -1.0;
+  imp_->have_previous_sample = false;
+  imp_->replay_stats.reset();
   imp_->ray_cloud = false;
   imp_->preload_samples = std::vector<SamplePoint>();
 }
@@ -186,6 +436,12 @@ bool SlamCloudLoader::trajectoryFileIsOpen() const
 }
 
 
+const ohm::TrajectoryIndex &SlamCloudLoader::trajectory() const
+{
+  return imp_->trajectory;
+}
+
+
 bool SlamCloudLoader::hasTimestamp() const
 {
   return imp_->sample_reader && (imp_->sample_reader->availableChannels() & DataChannel::Time) != DataChannel::None;
@@ -239,7 +495,8 @@ void SlamCloudLoader::preload(size_t point_count)
   preload_data.reserve(point_count);
 
   SamplePoint sample{};
-  while (nextSample(sample) && (preload_data.size() < point_count || load_all))
+  // Check the count first so we don't read and drop an extra sample.
+  while ((preload_data.size() < point_count || load_all) && nextSample(sample))
   {
     preload_data.emplace_back(sample);
   }
@@ -258,33 +515,66 @@ bool SlamCloudLoader::nextSample(SamplePoint &sample)
 
     // Read next sample.
     sample = imp_->next_sample;
+    return true;
+  }
+  return false;
+}
 
-    // If in real time mode, sleep until we should deliver this sample.
-    if (imp_->real_time_mode && imp_->first_sample_timestamp >= 0)
+
+size_t SlamCloudLoader::nextSamples(std::vector<SamplePoint> &samples, size_t max_count)
+{
+  samples.clear();
+  max_count = (max_count) ? max_count : imp_->pipeline_chunk_size;
+
+  // Hand over a whole pipeline chunk when we can.
+  if (imp_->preload_index >= imp_->preload_samples.size())
+  {
+    startPipeline();
+    SlamCloudLoaderPipeline *pipeline = imp_->pipeline.get();
+    if (pipeline && pipeline->current_index >= pipeline->current.size() && pipeline->nextChunk() &&
+        pipeline->current.size() <= max_count)
     {
-      const double sample_relative_time = sample.timestamp - imp_->first_sample_timestamp;
-      if (sample_relative_time > 0)
-      {
-        auto uptime = Clock::now() - imp_->first_sample_read_time;
-        const double sleep_time =
-          sample_relative_time - std::chrono::duration_cast<std::chrono::duration<double>>(uptime).count();
-        if (sleep_time > 0)
-        {
-          std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
-        }
-      }
+      std::swap(samples, pipeline->current);
+      pipeline->current.clear();
+      pipeline->current_index = 0;
+      imp_->next_sample = samples.back();
+      imp_->read_count += samples.size();
+      return samples.size();
     }
-    return true;
   }
-  return false;
+
+  samples.reserve(max_count);
+  SamplePoint sample{};
+  while (samples.size() < max_count && nextSample(sample))
+  {
+    samples.emplace_back(sample);
+  }
+
+  return samples.size();
 }
 
 
-bool SlamCloudLoader::open(const char *sample_file_path, const char *trajectory_file_path, bool ray_cloud)
+bool SlamCloudLoader::open(const std::vector<SensorInput> &inputs, const char *trajectory_file_path, bool ray_cloud)
 {
   close();
 
-  imp_->sample_reader = slamio::createCloudReaderFromFilename(sample_file_path);
+  if (inputs.empty() || inputs.size() > kMaxSensorInputs)
+  {
+    error(imp_->error_log, "Unsupported number of sensor files: ", inputs.size());
+    return false;
+  }
+
+  std::vector<PointCloudReaderPtr> sample_readers;
+  for (const auto &input : inputs)
+  {
+    sample_readers.emplace_back(slamio::createCloudReaderFromFilename(input.sample_file_path.c_str()));
+    if (!sample_readers.back())
+    {
+      error(imp_->error_log, "Unsupported extension for point cloud file ", input.sample_file_path);
+      close();
+      return false;
+    }
+  }
 
   if (!ray_cloud)
   {
@@ -301,13 +591,6 @@ bool SlamCloudLoader::open(const char *sample_file_path, const char *trajectory_
     }
   }
 
-  if (!imp_->sample_reader)
-  {
-    error(imp_->error_log, "Unsupported extension for point cloud file ", sample_file_path);
-    close();
-    return false;
-  }
-
   DataChannel required_channels = DataChannel::Position;
   if (ray_cloud)
   {
@@ -327,7 +610,7 @@ bool SlamCloudLoader::open(const char *sample_file_path, const char *trajectory_
       return false;
     }
 
-    if (imp_->trajectory_reader->readChunk(imp_->trajectory_buffer, 2) != 2)
+    if (!loadTrajectory() || imp_->trajectory.count() < 2)
     {
       std::cerr << "Failed to read data from trajectory file " << trajectory_file_path << std::endl;
       error(imp_->error_log, "Failed to read data from trajectory file ", trajectory_file_path);
@@ -346,31 +629,49 @@ bool SlamCloudLoader::open(const char *sample_file_path, const char *trajectory_
     required_channels |= DataChannel::Time;
   }
 
-  // Set desired channels to include the required channels and ones we could additionally use.
-  imp_->sample_reader->setDesiredChannels(required_channels | DataChannel::Colour | DataChannel::Intensity |
-                                          DataChannel::ReturnNumber);
-  if (!imp_->sample_reader->open(sample_file_path))
+  if (inputs.size() > 1)
   {
-    error(imp_->error_log, "Unable to open point cloud ", sample_file_path);
-    close();
-    return false;
+    // Need time to merge the sensor files.
+    required_channels |= DataChannel::Time;
   }
 
-  if (!imp_->trajectory_reader)
+  for (size_t i = 0; i < inputs.size(); ++i)
   {
-    if (ray_cloud)
+    PointCloudReader &sample_reader = *sample_readers[i];
+    const char *sample_file_path = inputs[i].sample_file_path.c_str();
+
+    // Set desired channels to include the required channels and ones we could additionally use.
+    sample_reader.setDesiredChannels(required_channels | DataChannel::Colour | DataChannel::Intensity |
+                                     DataChannel::ReturnNumber);
+    if (!sample_reader.open(sample_file_path))
+    {
+      error(imp_->error_log, "Unable to open point cloud ", sample_file_path);
+      close();
+      return false;
+    }
+
+    // Check for required channels.
+    if ((required_channels & sample_reader.availableChannels()) != required_channels)
     {
-      // Ray cloud expects normals.
-      required_channels |= DataChannel::Normal;
+      error(imp_->error_log, "Unable to load required data channels from point cloud ", sample_file_path);
+      close();
+      return false;
     }
   }
 
-  // Check for required channels.
-  if ((required_channels & imp_->sample_reader->availableChannels()) != required_channels)
+  if (sample_readers.size() == 1)
   {
-    error(imp_->error_log, "Unable to load required data channels from point cloud ", sample_file_path);
-    close();
-    return false;
+    imp_->sample_reader = sample_readers.front();
+  }
+  else
+  {
+    imp_->sample_reader = std::make_shared<MergedCloudReader>(sample_readers, imp_->pipeline_chunk_size,
+                                                              imp_->pipeline_queue_depth);
+    imp_->sensor_transforms.clear();
+    for (const auto &input : inputs)
+    {
+      imp_->sensor_transforms.emplace_back(input.sensor_transform);
+    }
   }
 
   imp_->infer_return_number = imp_->allow_return_number_inference && (imp_->sample_reader->availableChannels() &
@@ -391,81 +692,274 @@ bool SlamCloudLoader::loadPoint()
   if (!imp_->preload_samples.empty())
   {
     // Preload done. Release the memory for preload_samples
-    imp_->preload_samples.shrink_to_fit();
+    imp_->preload_samples = std::vector<SamplePoint>();
     imp_->preload_index = 0;
   }
 
-  CloudPoint point{};
-  if (imp_->sample_reader && imp_->sample_reader->readNext(point))
+  bool have_sample = false;
+  startPipeline();
+  if (imp_->pipeline)
+  {
+    SlamCloudLoaderPipeline &pipeline = *imp_->pipeline;
+    if (pipeline.current_index < pipeline.current.size() || pipeline.nextChunk())
+    {
+      imp_->next_sample = pipeline.current[pipeline.current_index++];
+      have_sample = true;
+    }
+  }
+  else
   {
-    SamplePoint sample = c2sPt(point);
+    CloudPoint point{};
+    if (imp_->sample_reader && imp_->sample_reader->readNext(point))
+    {
+      imp_->next_sample = convertPoint(point);
+      have_sample = true;
+    }
+  }
+
+  return have_sample;
+}
+
+
+SamplePoint SlamCloudLoader::convertPoint(const CloudPoint &point)
+{
+  SamplePoint sample = c2sPt(point);
 
-    const bool is_first_sample = imp_->first_sample_timestamp < 0;
-    bool is_secondary_return = !is_first_sample && point.return_number > 0;
+  const bool is_first_sample = !imp_->have_previous_sample;
+  bool is_secondary_return = !is_first_sample && point.return_number > 0;
 
-    // Infer secondary returns if the return number is not available.
-    // Only if this is not the first point sample.
-    if (!is_first_sample && imp_->infer_return_number)
+  // Infer secondary returns if the return number is not available.
+  // Only if this is not the first point sample.
+  if (!is_first_sample && imp_->infer_return_number)
+  {
+    // We assume secondary returns can occur when sequential points from the same sensor have exactly the same
+    // timestamp.
+    if (sample.timestamp == imp_->previous_sample.timestamp &&
+        sample.sensor_index == imp_->previous_sample.sensor_index)
     {
-      // We assume secondary returns can occur when sequential points have exactly the same timestamp.
-      if (sample.timestamp == imp_->next_sample.timestamp)
-      {
-        sample.return_number = 1u;
-        is_secondary_return = true;
-        // std::cout << "infer dual return\n" << std::flush;
-      }
+      sample.return_number = 1u;
+      is_secondary_return = true;
     }
+  }
 
-    if (imp_->ray_cloud)
+  if (imp_->ray_cloud)
+  {
+    // Loading a ray cloud. The normal is the vector from sample back to sensor.
+    sample.origin = point.position + point.normal;
+  }
+  else
+  {
+    if (!is_secondary_return)
     {
-      // Loading a ray cloud. The normal is the vector from sample back to sensor.
-      sample.origin = point.position + point.normal;
+      sampleTrajectory(sample.origin, sample.sample, sample.timestamp, sample.sensor_index);
     }
     else
     {
-      if (!is_secondary_return)
+      // Use previous sample point as the sample origin for this one.
+      sample.origin = imp_->previous_sample.sample;
+    }
+  }
+
+  imp_->previous_sample = sample;
+  imp_->have_previous_sample = true;
+  return sample;
+}
+
+
+void SlamCloudLoader::startPipeline()
+{
+  // Real time replay is a pipeline stage.
+  if ((!imp_->pipeline_enabled && !imp_->real_time_mode) || imp_->pipeline || !imp_->sample_reader)
+  {
+    return;
+  }
+
+  imp_->pipeline = std::make_unique<SlamCloudLoaderPipeline>(imp_->pipeline_queue_depth);
+  SlamCloudLoaderPipeline *pipeline = imp_->pipeline.get();
+
+  // Reader stage: read raw point chunks.
+  const size_t chunk_size = imp_->pipeline_chunk_size;
+  PointCloudReaderPtr reader = imp_->sample_reader;
+  pipeline->reader_thread = std::thread([pipeline, reader, chunk_size]() {
+    for (;;)
+    {
+      std::vector<CloudPoint> chunk(chunk_size);
+      chunk.resize(reader->readChunk(chunk.data(), chunk.size()));
+      if (chunk.empty() || !pipeline->cloud_chunks.push(std::move(chunk)))
+      {
+        break;
+      }
+    }
+    pipeline->cloud_chunks.close();
+  });
+
+  // Interpolation stage: convert to samples, resolving the trajectory. This is the only user of the trajectory reader
+  // and conversion state while the pipeline runs.
+  pipeline->interpolation_thread = std::thread([this, pipeline]() {
+    std::vector<CloudPoint> chunk;
+    while (pipeline->cloud_chunks.pop(chunk))
+    {
+      std::vector<SamplePoint> samples;
+      samples.reserve(chunk.size());
+      for (const auto &point : chunk)
       {
-        sampleTrajectory(sample.origin, sample.sample, sample.timestamp);
+        samples.emplace_back(convertPoint(point));
       }
-      else
+      if (!pipeline->sample_chunks.push(std::move(samples)))
       {
-        // Use previous sample point as the sample origin for this one.
-        sample.origin = imp_->next_sample.sample;
+        // Aborted. Ensure the reader stage stops.
+        pipeline->cloud_chunks.close(true);
+        break;
       }
     }
-    imp_->next_sample = sample;
+    pipeline->sample_chunks.close();
+  });
+
+  if (imp_->real_time_mode)
+  {
+    pipeline->replay = true;
+    pipeline->replay_stats = &imp_->replay_stats;
+    startReplay();
+  }
+}
 
-    if (is_first_sample)
+
+void SlamCloudLoader::startReplay()
+{
+  SlamCloudLoaderPipeline *pipeline = imp_->pipeline.get();
+  const double rate = imp_->real_time_rate;
+  const double batch_period = imp_->real_time_batch_period;
+  const DropPolicy drop_policy = imp_->real_time_drop_policy;
+
+  // Replay stage: split sample chunks into batches and release each batch at the real time of its last sample.
+  // Release times are relative to a fixed epoch so sleep overshoot does not accumulate.
+  pipeline->replay_thread = std::thread([pipeline, rate, batch_period, drop_policy]() {
+    std::vector<SamplePoint> chunk;
+    Clock::time_point epoch_time;
+    Clock::time_point last_release_time;
+    double epoch_timestamp = 0;
+    bool have_epoch = false;
+    bool ok = true;
+    while (ok && pipeline->sample_chunks.pop(chunk))
     {
-      imp_->first_sample_timestamp = sample.timestamp;
-      imp_->first_sample_read_time = Clock::now();
+      for (size_t begin = 0; ok && begin < chunk.size();)
+      {
+        if (!have_epoch)
+        {
+          epoch_timestamp = chunk[begin].timestamp;
+          epoch_time = last_release_time = Clock::now();
+          have_epoch = true;
+        }
+
+        const double batch_end_timestamp = chunk[begin].timestamp + batch_period;
+        size_t end = begin + 1;
+        while (end < chunk.size() && chunk[end].timestamp < batch_end_timestamp)
+        {
+          ++end;
+        }
+
+        SlamCloudLoaderBatch batch;
+        batch.samples.assign(chunk.begin() + begin, chunk.begin() + end);
+        const double replay_time = std::max(0.0, (batch.samples.back().timestamp - epoch_timestamp) / rate);
+        const auto replay_offset =
+          std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(replay_time));
+        // Never release out of order, even if the timestamps are.
+        batch.release_time = std::max(last_release_time, epoch_time + replay_offset);
+        last_release_time = batch.release_time;
+
+        ok = pipeline->waitUntil(batch.release_time) && pipeline->releaseBatch(std::move(batch), drop_policy);
+        begin = end;
+      }
     }
-    return true;
+
+    if (!ok)
+    {
+      // Aborted. Ensure the earlier stages stop.
+      pipeline->sample_chunks.close(true);
+      pipeline->cloud_chunks.close(true);
+    }
+    pipeline->replay_batches.close();
+  });
+}
+
+
+void SlamCloudLoader::stopPipeline()
+{
+  if (!imp_->pipeline)
+  {
+    return;
   }
-  return false;
+
+  SlamCloudLoaderPipeline &pipeline = *imp_->pipeline;
+  {
+    std::unique_lock<std::mutex> guard(pipeline.replay_lock);
+    pipeline.stopping = true;
+  }
+  pipeline.replay_wake.notify_all();
+  pipeline.replay_batches.close(true);
+  pipeline.sample_chunks.close(true);
+  pipeline.cloud_chunks.close(true);
+  if (pipeline.reader_thread.joinable())
+  {
+    pipeline.reader_thread.join();
+  }
+  if (pipeline.interpolation_thread.joinable())
+  {
+    pipeline.interpolation_thread.join();
+  }
+  if (pipeline.replay_thread.joinable())
+  {
+    pipeline.replay_thread.join();
+  }
+  imp_->pipeline.reset();
 }
 
 
-bool SlamCloudLoader::sampleTrajectory(glm::dvec3 &position, const glm::dvec3 &sample, double timestamp)
+bool SlamCloudLoader::loadTrajectory()
 {
-  if (imp_->trajectory_reader)
+  imp_->trajectory.clear();
+  if (const uint64_t point_count = imp_->trajectory_reader->pointCount())
   {
-    CloudPoint traj_point;
+    imp_->trajectory.reserve(size_t(point_count));
+  }
 
-    while (timestamp > imp_->trajectory_buffer[1].timestamp && imp_->trajectory_reader->readNext(traj_point))
+  std::vector<CloudPoint> chunk(imp_->pipeline_chunk_size);
+  size_t out_of_order_count = 0;
+  while (const uint64_t read_count = imp_->trajectory_reader->readChunk(chunk.data(), chunk.size()))
+  {
+    for (uint64_t i = 0; i < read_count; ++i)
     {
-      imp_->trajectory_buffer[0] = imp_->trajectory_buffer[1];
-      imp_->trajectory_buffer[1] = traj_point;
+      if (!imp_->trajectory.add(chunk[i].timestamp, chunk[i].position))
+      {
+        ++out_of_order_count;
+      }
     }
+  }
 
-    if (imp_->trajectory_buffer[0].timestamp <= timestamp && timestamp <= imp_->trajectory_buffer[1].timestamp &&
-        imp_->trajectory_buffer[0].timestamp != imp_->trajectory_buffer[1].timestamp)
+  if (out_of_order_count)
+  {
+    error(imp_->error_log, "Skipped ", out_of_order_count, " out of order trajectory points");
+  }
+
+  imp_->trajectory.buildIndex();
+  return !imp_->trajectory.empty();
+}
+
+
+bool SlamCloudLoader::sampleTrajectory(glm::dvec3 &position, const glm::dvec3 &sample, double timestamp,
+                                       unsigned sensor_index)
+{
+  if (imp_->trajectory_reader)
+  {
+    glm::dquat rotation;
+    if (imp_->trajectory.pose(timestamp, position, rotation))
     {
-      const double lerp = (timestamp - imp_->trajectory_buffer[0].timestamp) /
-                          (imp_->trajectory_buffer[1].timestamp - imp_->trajectory_buffer[0].timestamp);
-      position = imp_->trajectory_buffer[0].position +
-                 lerp * (imp_->trajectory_buffer[1].position - imp_->trajectory_buffer[0].position);
       position += imp_->trajectory_to_sensor_offset;
+      if (sensor_index < imp_->sensor_transforms.size())
+      {
+        // Offset to the sensor which generated the sample.
+        position += rotation * glm::dvec3(imp_->sensor_transforms[sensor_index][3]);
+      }
       return true;
     }
   }
@@ -10,8 +10,15 @@
 
 #include "Points.h"
 
+#include <ohmutil/TrajectoryIndex.h>
+
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace slamio
 {
@@ -24,8 +31,9 @@ struct SlamCloudLoaderDetail;
 /// Building with @c OHM_FEATURE_PDAL enables PDAL support for other point cloud data types, with PLY loading unchanged.
 /// PDAL version 1.7+ supports streaming loading.
 ///
-/// The loader may be opened in one of three ways:
+/// The loader may be opened in one of four ways:
 /// -# @c openWithTrajectory() to load separate point cloud and trajectories.
+/// -# @c openMultiSensor() to merge point clouds from multiple sensors, with a shared trajectory.
 /// -# @c openPointCloud() to load data samples with no trajectory.
 /// -# @c openRayCloud() to open a self contained ray cloud.
 ///
@@ -34,6 +42,11 @@ struct SlamCloudLoaderDetail;
 /// pairs, thus both files must contain correlated timestamps. The @c SamplePoint::origin values are reported as
 /// @c (0,0,0) when timestamps cannot be matched.
 ///
+/// Using @c openMultiSensor() opens a point cloud file per sensor, such as for multiple lidars logged separately. The
+/// files are read ahead on background threads and merged on the fly in timestamp order, so each file must be in
+/// timestamp order. Each @c SensorInput carries an extrinsic transform for the sensor. The
+/// @c SamplePoint::sensor_index identifies the source file for each sample.
+///
 /// Using @c openPointCloud() opens a point cloud without trajectory. The @c SamplePoint::origin values are reported at
 /// the same location as the @c SamplePoint::sample positions.
 ///
@@ -65,14 +78,77 @@ struct SlamCloudLoaderDetail;
 ///   }
 /// }
 /// @endcode
+///
+/// Loading may optionally be pipelined using @c enablePipeline() . A pipelined loader reads @c CloudPoint chunks
+/// on a background thread via @c PointCloudReader::readChunk() , while a second thread converts the chunks into
+/// @c SamplePoint data, interpolating the trajectory. Each stage is connected by a bounded queue holding at most
+/// @c pipelineQueueDepth() chunks of @c pipelineChunkSize() points. Whole chunks may then be collected using
+/// @c nextSamples() .
+///
+/// A loader constructed in real time mode replays the data at the rate given by the sample timestamps, scaled by
+/// @c realTimeRate() . Real time mode always uses the pipeline, adding a replay stage which splits the converted
+/// chunks into batches spanning at most @c realTimeBatchPeriod() of sample time. Each batch is released when the
+/// wall clock reaches the batch's last sample time, relative to the first replayed sample, so that scheduling does
+/// not drift. Released batches are held in a queue of up to @c pipelineQueueDepth() batches. The
+/// @c realTimeDropPolicy() determines the behaviour when the consumer falls behind and this queue is full, while
+/// @c realTimeStats() reports the consumer lag and dropped data.
 class slamio_API SlamCloudLoader
 {
 public:
   /// Logging function hook.
   using Log = std::function<void(const char *)>;
 
+  /// Default number of points in each pipeline chunk.
+  static constexpr size_t kDefaultPipelineChunkSize = 4096u;
+  /// Default number of chunks which may be queued between pipeline stages.
+  static constexpr size_t kDefaultPipelineQueueDepth = 4u;
+  /// Maximum number of files supported by @c openMultiSensor() , limited by @c SamplePoint::sensor_index .
+  static constexpr size_t kMaxSensorInputs = 256u;
+  /// Default maximum sample time spanned by each real time replay batch (seconds).
+  static constexpr double kDefaultRealTimeBatchPeriod = 0.01;
+
+  /// Real time replay behaviour when the consumer falls behind the replay. See @c setRealTimeDropPolicy() .
+  enum class DropPolicy
+  {
+    /// Block the replay until the consumer catches up. No data are dropped, but replay falls behind real time.
+    kBlock,
+    /// Drop the oldest queued batch to make room for the new batch.
+    kDropOldest,
+    /// Drop the new batch, keeping the queued batches.
+    kDropNewest
+  };
+
+  /// Real time replay statistics. See @c realTimeStats() .
+  struct RealTimeStats
+  {
+    /// Number of batches given to the consumer.
+    uint64_t batches = 0;
+    /// Number of batches dropped by the @c DropPolicy .
+    uint64_t dropped_batches = 0;
+    /// Number of samples dropped by the @c DropPolicy .
+    uint64_t dropped_samples = 0;
+    /// Wall clock delay between the scheduled release and the consumer collecting the last batch (seconds).
+    double lag = 0;
+    /// Maximum @c lag observed (seconds).
+    double max_lag = 0;
+    /// Mean @c lag over all @c batches (seconds).
+    double mean_lag = 0;
+  };
+
+  /// A sensor sample file for @c openMultiSensor() .
+  struct SensorInput
+  {
+    /// Point cloud file name for the sensor.
+    std::string sample_file_path;
+    /// Extrinsic transform from the trajectory frame to the sensor frame. The translation is rotated by the
+    /// interpolated trajectory orientation and added to the trajectory position, in addition to the
+    /// @c sensorOffset() , to resolve the sensor origin for each sample.
+    glm::dmat4 sensor_transform = glm::dmat4(1.0);
+  };
+
   /// Create a SLAM cloud loader.
-  /// @param real_time_mode True to throttle point loading to simulate real time data acquisition.
+  /// @param real_time_mode True to replay points at the rate given by their timestamps, simulating real time data
+  ///   acquisition. See the class documentation.
   explicit SlamCloudLoader(bool real_time_mode = false);
 
   /// Set the error logging function.
@@ -103,6 +179,61 @@ public:
   /// Check if return number inference is enabled. See @c enableReturnNumberInference() .
   bool returnNumberInference() const;
 
+  /// Enable or disable the background loading pipeline. The pipeline threads are started on the first sample request
+  /// after opening, so the loader configuration - e.g., @c setSensorOffset() - may still be modified after @c open() ,
+  /// but not after the first sample has been read.
+  ///
+  /// Must be enabled before calling @c open() as this has no effect on an open data stream.
+  ///
+  /// @param enable True to load using background threads.
+  void enablePipeline(bool enable);
+
+  /// Check if the background loading pipeline is enabled. See @c enablePipeline() .
+  bool pipelineEnabled() const;
+
+  /// Set the number of points read in each pipeline chunk. Must be set before calling @c open() .
+  /// @param chunk_size The number of points per chunk. Zero selects @c kDefaultPipelineChunkSize .
+  void setPipelineChunkSize(size_t chunk_size);
+
+  /// Query the number of points read in each pipeline chunk.
+  size_t pipelineChunkSize() const;
+
+  /// Set the maximum number of chunks queued between pipeline stages. Must be set before calling @c open() .
+  /// @param queue_depth The queue depth. Zero selects @c kDefaultPipelineQueueDepth .
+  void setPipelineQueueDepth(size_t queue_depth);
+
+  /// Query the maximum number of chunks queued between pipeline stages.
+  size_t pipelineQueueDepth() const;
+
+  /// Set the real time replay rate multiplier. For example, 2 replays at twice real time. Must be set before the
+  /// first sample is read.
+  /// @param rate The replay rate. Values less than or equal to zero select 1.
+  void setRealTimeRate(double rate);
+
+  /// Query the real time replay rate multiplier.
+  double realTimeRate() const;
+
+  /// Set the maximum sample time spanned by each real time replay batch. Must be set before the first sample is
+  /// read.
+  /// @param period The batch period (seconds). Values less than or equal to zero select
+  ///   @c kDefaultRealTimeBatchPeriod .
+  void setRealTimeBatchPeriod(double period);
+
+  /// Query the maximum sample time spanned by each real time replay batch (seconds).
+  double realTimeBatchPeriod() const;
+
+  /// Set the behaviour when the consumer falls behind the real time replay. Must be set before the first sample is
+  /// read.
+  /// @param policy The drop policy.
+  void setRealTimeDropPolicy(DropPolicy policy);
+
+  /// Query the real time @c DropPolicy .
+  DropPolicy realTimeDropPolicy() const;
+
+  /// Query the real time replay statistics since opening. Should be called from the thread collecting samples.
+  /// @return The replay statistics.
+  RealTimeStats realTimeStats() const;
+
   /// Open the given point cloud and trajectory file pair. Both file must be valid. The @p sample_file_path must be a
   /// point cloud file, while @p trajectory_file_path can be either a point cloud file or a text trajectory.
   ///
@@ -122,6 +253,18 @@ public:
   /// @return True on successfully opening both files.
   bool openWithTrajectory(const char *sample_file_path, const char *trajectory_file_path);
 
+  /// Open multiple point cloud files, one per sensor, with a shared trajectory. Samples are merged in timestamp order
+  /// and the origin for each sample is resolved from the trajectory and the @c SensorInput::sensor_transform of the
+  /// sample's sensor. All files must have timestamps.
+  ///
+  /// The read ahead for each file uses @c pipelineChunkSize() and @c pipelineQueueDepth() , which must be set before
+  /// calling this function.
+  ///
+  /// @param inputs The sensor files and transforms. At most @c kMaxSensorInputs .
+  /// @param trajectory_file_path Point cloud or trajectory file name. May be null or empty to load samples only.
+  /// @return True on successfully opening all files.
+  bool openMultiSensor(const std::vector<SensorInput> &inputs, const char *trajectory_file_path);
+
   /// Open the given point cloud file. This generates @c CloudSample values which have a fixed, zero @p origin value.
   /// @param sample_file_path Point cloud file name.
   /// @return True on successfully opening the point cloud.
@@ -152,6 +295,11 @@ public:
   /// Do we have a trajectory?
   bool trajectoryFileIsOpen() const;
 
+  /// Access the trajectory loaded by @c openWithTrajectory() or @c openMultiSensor() . The trajectory file is fully
+  /// loaded on opening and indexed for constant time pose lookup. Empty when there is no trajectory.
+  /// @return The indexed trajectory.
+  const ohm::TrajectoryIndex &trajectory() const;
+
   /// True if the input data has a timestamp channel.
   bool hasTimestamp() const;
 
@@ -174,20 +322,54 @@ public:
   /// Get the next point, sensor position and timestamp.
   bool nextSample(SamplePoint &sample);
 
+  /// Get a batch of sample points. The @p samples are cleared, then filled with up to @p max_count samples.
+  ///
+  /// Whole chunks are handed over from the pipeline without copying when the pipeline is enabled and the chunk fits
+  /// within @p max_count . Samples are otherwise read one at a time as for @c nextSample() . In real time mode,
+  /// samples become available one replay batch at a time, blocking until the next batch is released.
+  ///
+  /// @param[out] samples The sample points read.
+  /// @param max_count The maximum number of samples to read. Zero selects @c pipelineChunkSize() .
+  /// @return The number of samples read. Zero when there are no more data to read.
+  size_t nextSamples(std::vector<SamplePoint> &samples, size_t max_count = 0);
+
 private:
-  bool open(const char *sample_file_path, const char *trajectory_file_path, bool ray_cloud);
+  bool open(const std::vector<SensorInput> &inputs, const char *trajectory_file_path, bool ray_cloud);
 
   bool loadPoint();
 
+  /// Convert the @p point read from the point cloud into a @c SamplePoint , resolving the sample origin.
+  ///
+  /// Points must be converted in sequence as the previous sample is used to infer return numbers and trajectory
+  /// sampling is progressive.
+  ///
+  /// @param point The cloud point to convert.
+  /// @return The converted sample.
+  SamplePoint convertPoint(const CloudPoint &point);
+
+  /// Start the pipeline threads if the pipeline is enabled and not yet started.
+  void startPipeline();
+  /// Start the real time replay stage thread. Called from @c startPipeline() in real time mode.
+  void startReplay();
+  /// Stop and join any running pipeline threads, discarding pending data.
+  void stopPipeline();
+
+  /// Load the full trajectory from the trajectory reader into the @c trajectory() index.
+  /// @return True if any trajectory points were loaded.
+  bool loadTrajectory();
+
   /// Sample the trajectory at the given timestamp.
   ///
-  /// This reads the trajectory to the segment which covers @p timestamp and
-  /// linearly interpolates a @p position at this time.
+  /// This looks up the trajectory segment which covers @p timestamp in the @c trajectory() index and interpolates a
+  /// @p position at this time, adding the @c sensorOffset() and the sensor transform for @p sensor_index when
+  /// opened with @c openMultiSensor() .
   ///
   /// @param[out] position Set to the trajectory position on success.
+  /// @param sample The sample position, used as the @p position when there is no trajectory.
   /// @param timestamp The desired sample time.
+  /// @param sensor_index The index of the sensor which generated the sample.
   /// @return True on success, false when @p timestamp is out of range.
-  bool sampleTrajectory(glm::dvec3 &position, const glm::dvec3 &sample, double timestamp);
+  bool sampleTrajectory(glm::dvec3 &position, const glm::dvec3 &sample, double timestamp, unsigned sensor_index = 0);
 
   std::unique_ptr<SlamCloudLoaderDetail> imp_;
 };
@@ -6,6 +6,7 @@
 #include "SlamIO.h"
 
 #include "PointCloudReaderPly.h"
+#include "PointCloudReaderRayCloud.h"
 #include "PointCloudReaderTraj.h"
 #include "PointCloudReaderXyz.h"
 
@@ -50,6 +51,10 @@ PointCloudReaderPtr createCloudReader(const char *extension_c)
   {
     reader = std::make_shared<PointCloudReaderPly>();
   }
+  else if (extension == "rcb")
+  {
+    reader = std::make_shared<PointCloudReaderRayCloud>();
+  }
   else if (extension == "txt")
   {
     reader = std::make_shared<PointCloudReaderTraj>();
@@ -34,7 +34,9 @@
 
 // clang-format on
 
+#cmakedefine01 SLAMIO_HAVE_LZ4
 #cmakedefine01 SLAMIO_HAVE_PDAL
 #cmakedefine01 SLAMIO_HAVE_PDAL_STREAMS
+#cmakedefine01 SLAMIO_HAVE_PDAL_PARALLEL
 
 #endif  // SLAMIO_SLAMIOCONFIG_H_
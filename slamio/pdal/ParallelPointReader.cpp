@@ -0,0 +1,158 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "ParallelPointReader.h"
+
+#include "PointStream.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace slamio
+{
+namespace
+{
+/// Number of points PDAL streams between each @c PointStream::reset() while loading a block.
+const size_t kBlockStreamBufferSize = 10000u;
+/// Number of blocks each thread may claim ahead of the reading thread.
+const uint64_t kBlocksAheadPerThread = 2u;
+}  // namespace
+
+ParallelPointReader::ParallelPointReader(ReaderFactory reader_factory, uint64_t point_count, DataChannel required,
+                                         unsigned thread_count, uint64_t block_size)
+  : reader_factory_(std::move(reader_factory))
+  , point_count_(point_count)
+  , block_size_(std::max<uint64_t>(block_size, 1u))
+  , required_(required)
+{
+  block_count_ = (point_count_ + block_size_ - 1) / block_size_;
+  thread_count = std::max(1u, unsigned(std::min<uint64_t>(thread_count, block_count_)));
+  max_blocks_ahead_ = thread_count * kBlocksAheadPerThread;
+  workers_.reserve(thread_count);
+  for (unsigned i = 0; i < thread_count; ++i)
+  {
+    workers_.emplace_back([this]() { work(); });
+  }
+}
+
+
+ParallelPointReader::~ParallelPointReader()
+{
+  abort();
+  for (auto &worker : workers_)
+  {
+    worker.join();
+  }
+}
+
+
+bool ParallelPointReader::nextPoint(CloudPoint &point)
+{
+  while (current_index_ >= current_.size())
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    if (read_block_ >= block_count_)
+    {
+      return false;
+    }
+
+    block_ready_.wait(guard, [this]() { return aborted_ || failed_ || completed_.count(read_block_); });
+    const auto block = completed_.find(read_block_);
+    if (block == completed_.end())
+    {
+      // Aborted or failed.
+      return false;
+    }
+
+    current_ = std::move(block->second);
+    current_index_ = 0;
+    completed_.erase(block);
+    ++read_block_;
+    guard.unlock();
+    block_consumed_.notify_all();
+  }
+
+  point = current_[current_index_++];
+  return true;
+}
+
+
+void ParallelPointReader::abort()
+{
+  std::unique_lock<std::mutex> guard(mutex_);
+  aborted_ = true;
+  guard.unlock();
+  block_ready_.notify_all();
+  block_consumed_.notify_all();
+}
+
+
+void ParallelPointReader::work()
+{
+  // PDAL stages are owned by the factory which creates them. Use a factory per thread.
+  pdal::StageFactory factory;
+  std::vector<CloudPoint> points;
+
+  while (true)
+  {
+    std::unique_lock<std::mutex> guard(mutex_);
+    block_consumed_.wait(guard, [this]() {
+      return aborted_ || failed_ || next_block_ >= block_count_ || next_block_ < read_block_ + max_blocks_ahead_;
+    });
+    if (aborted_ || failed_ || next_block_ >= block_count_)
+    {
+      return;
+    }
+    const uint64_t block_index = next_block_++;
+    guard.unlock();
+
+    const bool ok = loadBlock(factory, block_index, points);
+
+    guard.lock();
+    if (ok)
+    {
+      completed_.emplace(block_index, std::move(points));
+    }
+    else if (!aborted_)
+    {
+      std::cerr << "Failed to load points [" << block_index * block_size_ << ", "
+                << std::min(point_count_, (block_index + 1) * block_size_) << ")" << std::endl;
+      failed_ = true;
+    }
+    guard.unlock();
+    block_ready_.notify_all();
+    if (!ok)
+    {
+      block_consumed_.notify_all();
+    }
+  }
+}
+
+
+bool ParallelPointReader::loadBlock(pdal::StageFactory &factory, uint64_t block_index, std::vector<CloudPoint> &points)
+{
+  const uint64_t start = block_index * block_size_;
+  const uint64_t count = std::min(block_size_, point_count_ - start);
+
+  points.clear();
+  auto reader = reader_factory_(factory, start, count);
+  if (!reader)
+  {
+    return false;
+  }
+
+  PointStream stream(kBlockStreamBufferSize, required_, true);
+  reader->prepare(stream);
+  stream.finalize();
+  if (!stream.isValid())
+  {
+    return false;
+  }
+
+  reader->execute(stream);
+  points = stream.takeCollected();
+  return points.size() == count;
+}
+}  // namespace slamio
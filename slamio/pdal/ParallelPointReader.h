@@ -0,0 +1,106 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_PDAL_PARALLELPOINTREADER_H_
+#define SLAMIO_PDAL_PARALLELPOINTREADER_H_
+
+#include "slamio/SlamIOConfig.h"
+
+#include "slamio/DataChannel.h"
+#include "slamio/Points.h"
+
+#include <pdal/Streamable.hpp>
+#include <pdal/StageFactory.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace slamio
+{
+/// Loads a point cloud file using multiple PDAL readers in parallel, each reading a block of points from a different
+/// point range of the file.
+///
+/// This is intended for LAS/LAZ files where the decompression is the bottleneck. LAZ data are compressed in chunks
+/// and PDAL seeks to the chunk containing a block's start point, so each worker decompresses different chunks.
+///
+/// Blocks are claimed in order by the worker threads and completed blocks are held in a reorder buffer until the
+/// reading thread reaches them. Points are thus presented in file order, preserving the timestamp order expected by
+/// @c SlamCloudLoader trajectory interpolation. The number of blocks held at any time is bounded, limiting memory use
+/// when the reader falls behind.
+class ParallelPointReader
+{
+public:
+  /// Function used to create a PDAL reader for the range `[start, start + count)` .
+  using ReaderFactory =
+    std::function<std::shared_ptr<pdal::Streamable>(pdal::StageFactory &, uint64_t start, uint64_t count)>;
+
+  /// Constructor. Starts the worker threads.
+  /// @param reader_factory Function used to create a reader for each block.
+  /// @param point_count The number of points in the file.
+  /// @param required The data channels to load.
+  /// @param thread_count The number of worker threads.
+  /// @param block_size Number of points in each block.
+  ParallelPointReader(ReaderFactory reader_factory, uint64_t point_count, DataChannel required,
+                      unsigned thread_count, uint64_t block_size);
+  /// Destructor, aborting and joining the worker threads.
+  ~ParallelPointReader();
+
+  /// Read the next point in file order, blocking until it's available.
+  /// @param[out] point Set to the next point.
+  /// @return False once all points have been read, on abort or on failure to load a block.
+  bool nextPoint(CloudPoint &point);
+
+  /// Abort loading.
+  void abort();
+
+private:
+  /// Worker thread loop.
+  void work();
+
+  /// Load the block at @p block_index .
+  /// @param factory The PDAL stage factory for this thread.
+  /// @param block_index The block to load.
+  /// @param[out] points Populated with the block points.
+  /// @return True on success.
+  bool loadBlock(pdal::StageFactory &factory, uint64_t block_index, std::vector<CloudPoint> &points);
+
+  ReaderFactory reader_factory_;
+  uint64_t point_count_ = 0;
+  uint64_t block_size_ = 0;
+  uint64_t block_count_ = 0;
+  DataChannel required_;
+  /// Maximum number of blocks claimed ahead of the reading thread.
+  uint64_t max_blocks_ahead_ = 0;
+
+  std::mutex mutex_;
+  /// Notified when a block completes.
+  std::condition_variable block_ready_;
+  /// Notified when the reading thread moves on to the next block.
+  std::condition_variable block_consumed_;
+  /// Completed blocks waiting to be read, keyed by block index.
+  std::map<uint64_t, std::vector<CloudPoint>> completed_;
+  /// Next block to be claimed by a worker.
+  uint64_t next_block_ = 0;
+  /// The block being read.
+  uint64_t read_block_ = 0;
+  bool aborted_ = false;
+  bool failed_ = false;
+
+  /// The block being read. Only accessed by the reading thread.
+  std::vector<CloudPoint> current_;
+  /// Next point index in @c current_ .
+  size_t current_index_ = 0;
+
+  std::vector<std::thread> workers_;
+};
+}  // namespace slamio
+
+#endif  // SLAMIO_PDAL_PARALLELPOINTREADER_H_
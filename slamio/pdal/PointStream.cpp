@@ -7,9 +7,10 @@
 
 namespace slamio
 {
-PointStream::PointStream(size_t buffer_capacity, DataChannel require)
+PointStream::PointStream(size_t buffer_capacity, DataChannel require, bool collect)
   : pdal::StreamPointTable(layout_, buffer_capacity)
   , required_channels_(require)
+  , collect_(collect)
 {
   // Register for the data we are interested in
   buffers_[0].reserve(buffer_capacity);
@@ -168,6 +169,7 @@ void PointStream::setFieldInternal(pdal::Dimension::Id dim, pdal::PointId idx, c
   if (!abort_)
   {
     auto &point_buffer = buffers_[write_index_];
+    idx += collect_offset_;
     while (point_buffer.size() <= idx)
     {
       point_buffer.emplace_back(CloudPoint{});
@@ -272,6 +274,13 @@ void PointStream::setFieldInternal(pdal::Dimension::Id dim, pdal::PointId idx, c
 /// Called whenever the buffer capacity is filled before starting on the next block.
 void PointStream::reset()
 {
+  if (collect_)
+  {
+    // Keep appending to the same buffer.
+    collect_offset_ = buffers_[write_index_].size();
+    return;
+  }
+
   if (!abort_)
   {
     std::unique_lock<std::mutex> guard(buffer_mutex_);
@@ -283,4 +292,13 @@ void PointStream::reset()
     have_data_ = true;
   }
 }
+
+
+std::vector<CloudPoint> PointStream::takeCollected()
+{
+  std::vector<CloudPoint> points;
+  std::swap(points, buffers_[write_index_]);
+  collect_offset_ = 0;
+  return points;
+}
 }  // namespace slamio
@@ -24,7 +24,13 @@ namespace slamio
 class PointStream : public pdal::StreamPointTable
 {
 public:
-  explicit PointStream(size_t buffer_capacity, DataChannel require = DataChannel::Position | DataChannel::Time);
+  /// Constructor.
+  /// @param buffer_capacity Number of points PDAL streams between each @c reset() .
+  /// @param require The data channels which must be available for @c isValid() .
+  /// @param collect Collect all points into a single growing buffer rather than double buffering with a reading
+  ///   thread. Use @c takeCollected() to access the points after @c execute() . Used to load blocks of points.
+  explicit PointStream(size_t buffer_capacity, DataChannel require = DataChannel::Position | DataChannel::Time,
+                       bool collect = false);
 
   /// Called when execute() is started.  Typically used to set buffer size
   /// when all dimensions are known.
@@ -59,6 +65,10 @@ public:
   /// Mark loading as done: only to be called from the loading thread.
   inline void markLoadComplete() { loading_complete_ = true; }
 
+  /// Take the points loaded in collect mode. Only valid once loading is complete.
+  /// @return The collected points.
+  std::vector<CloudPoint> takeCollected();
+
   inline bool hasTimestamp() const { return (available_channels_ & DataChannel::Time) != DataChannel::None; }
   inline bool hasNormals() const { return (available_channels_ & DataChannel::Normal) != DataChannel::None; }
   inline bool hasColourRgb() const { return (available_channels_ & DataChannel::ColourRgb) != DataChannel::None; }
@@ -95,6 +105,9 @@ private:
   std::atomic_bool valid_dimensions_{ false };
   DataChannel available_channels_ = DataChannel::None;
   DataChannel required_channels_ = DataChannel::Position | DataChannel::Time;
+  /// Offset added to point indices in collect mode, advanced on each @c reset() .
+  size_t collect_offset_ = 0;
+  bool collect_ = false;
 };
 }  // namespace slamio
 
@@ -0,0 +1,123 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_BOUNDEDQUEUE_H_
+#define SLAMIO_BOUNDEDQUEUE_H_
+
+#include "SlamIOConfig.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace slamio
+{
+/// A blocking, bounded queue used to connect the @c SlamCloudLoader pipeline stages and reader threads.
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1u))
+  {}
+
+  /// Push an item, blocking while the queue is full.
+  /// @return False if the queue has been closed and the item was not added.
+  bool push(T &&item)
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    not_full_.wait(guard, [this]() { return closed_ || items_.size() < capacity_; });
+    if (closed_)
+    {
+      return false;
+    }
+    items_.emplace_back(std::move(item));
+    guard.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /// Push an item without blocking.
+  /// @return False if the queue is full or closed, in which case @p item is not modified.
+  bool tryPush(T &&item)
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    if (closed_ || items_.size() >= capacity_)
+    {
+      return false;
+    }
+    items_.emplace_back(std::move(item));
+    guard.unlock();
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /// Pop an item without blocking.
+  /// @return False if the queue is empty.
+  bool tryPop(T &item)
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    if (items_.empty())
+    {
+      return false;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    guard.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /// Pop an item, blocking while the queue is empty and open.
+  /// @return False once the queue is closed and empty.
+  bool pop(T &item)
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    not_empty_.wait(guard, [this]() { return closed_ || !items_.empty(); });
+    if (items_.empty())
+    {
+      return false;
+    }
+    item = std::move(items_.front());
+    items_.pop_front();
+    guard.unlock();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /// Close the queue; no further items may be pushed. Items already queued may still be popped unless @p discard
+  /// is set.
+  void close(bool discard = false)
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    closed_ = true;
+    if (discard)
+    {
+      items_.clear();
+    }
+    guard.unlock();
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  /// Check if the queue has been closed.
+  bool isClosed() const
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    return closed_;
+  }
+
+private:
+  mutable std::mutex lock_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::deque<T> items_;
+  size_t capacity_;
+  bool closed_ = false;
+};
+}  // namespace slamio
+
+#endif  // SLAMIO_BOUNDEDQUEUE_H_
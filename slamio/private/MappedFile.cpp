@@ -0,0 +1,137 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MappedFile.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else  // _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _WIN32
+
+namespace slamio
+{
+MappedFile::MappedFile() = default;
+
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+
+bool MappedFile::open(const char *filename, bool sequential)
+{
+  close();
+
+#ifdef _WIN32
+  const DWORD access_flags =
+    FILE_ATTRIBUTE_NORMAL | ((sequential) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, access_flags, nullptr);
+  if (file != INVALID_HANDLE_VALUE)
+  {
+    LARGE_INTEGER file_size{};
+    if (GetFileSizeEx(file, &file_size))
+    {
+      open_ = true;
+      if (file_size.QuadPart > 0)
+      {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+          mapped_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+          if (mapped_)
+          {
+            mapping_handle_ = mapping;
+            size_ = size_t(file_size.QuadPart);
+          }
+          else
+          {
+            CloseHandle(mapping);
+          }
+        }
+      }
+    }
+    CloseHandle(file);
+  }
+#else   // _WIN32
+  const int fd = ::open(filename, O_RDONLY);
+  if (fd >= 0)
+  {
+    struct stat file_stat = {};
+    if (fstat(fd, &file_stat) == 0)
+    {
+      open_ = true;
+      if (file_stat.st_size > 0)
+      {
+        void *mapped = mmap(nullptr, size_t(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+          madvise(mapped, size_t(file_stat.st_size), (sequential) ? MADV_SEQUENTIAL : MADV_RANDOM);
+          mapped_ = mapped;
+          size_ = size_t(file_stat.st_size);
+        }
+      }
+    }
+    ::close(fd);
+  }
+#endif  // _WIN32
+
+  if (!open_)
+  {
+    return false;
+  }
+
+  if (mapped_)
+  {
+    begin_ = static_cast<const uint8_t *>(mapped_);
+    return true;
+  }
+
+  // Empty file or mapping failed. Read the whole file.
+  FILE *file_in = fopen(filename, "rb");
+  if (!file_in)
+  {
+    open_ = false;
+    return false;
+  }
+  uint8_t buffer[64 * 1024];
+  size_t read_bytes = 0;
+  while ((read_bytes = fread(buffer, 1, sizeof(buffer), file_in)) > 0)
+  {
+    fallback_.insert(fallback_.end(), buffer, buffer + read_bytes);
+  }
+  fclose(file_in);
+  begin_ = (!fallback_.empty()) ? fallback_.data() : nullptr;
+  size_ = fallback_.size();
+  return true;
+}
+
+
+void MappedFile::close()
+{
+  if (mapped_)
+  {
+#ifdef _WIN32
+    UnmapViewOfFile(mapped_);
+    CloseHandle(static_cast<HANDLE>(mapping_handle_));
+#else   // _WIN32
+    munmap(mapped_, size_);
+#endif  // _WIN32
+  }
+  mapped_ = nullptr;
+  mapping_handle_ = nullptr;
+  begin_ = nullptr;
+  size_ = 0;
+  fallback_.clear();
+  fallback_.shrink_to_fit();
+  open_ = false;
+}
+}  // namespace slamio
@@ -0,0 +1,56 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_MAPPEDFILE_H_
+#define SLAMIO_MAPPEDFILE_H_
+
+#include "SlamIOConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace slamio
+{
+/// A read only memory mapped file. Uses @c mmap() or @c MapViewOfFile() , falling back to reading the whole file into
+/// memory when the file cannot be mapped.
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /// Open and map @p filename .
+  /// @param filename The file to open.
+  /// @param sequential Hint that the file will be read sequentially.
+  /// @return True on success, including for an empty file.
+  bool open(const char *filename, bool sequential = true);
+  /// Close the file, releasing the mapping.
+  void close();
+  /// Is the file open?
+  /// @return True if open.
+  inline bool isOpen() const { return open_; }
+
+  /// Access the file content.
+  /// @return The file bytes. Null for an empty file.
+  inline const uint8_t *data() const { return begin_; }
+  /// Query the file size.
+  /// @return The file byte size.
+  inline size_t size() const { return size_; }
+
+private:
+  const uint8_t *begin_ = nullptr;
+  size_t size_ = 0;
+  void *mapped_ = nullptr;
+  void *mapping_handle_ = nullptr;  ///< Windows file mapping handle.
+  std::vector<uint8_t> fallback_;
+  bool open_ = false;
+};
+}  // namespace slamio
+
+#endif  // SLAMIO_MAPPEDFILE_H_
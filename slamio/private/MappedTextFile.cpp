@@ -0,0 +1,75 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MappedTextFile.h"
+
+#include <algorithm>
+
+namespace slamio
+{
+MappedTextFile::MappedTextFile() = default;
+
+
+MappedTextFile::~MappedTextFile()
+{
+  close();
+}
+
+
+bool MappedTextFile::open(const char *filename)
+{
+  close();
+  if (!file_.open(filename))
+  {
+    return false;
+  }
+
+  begin_ = reinterpret_cast<const char *>(file_.data());
+  end_ = begin_ + file_.size();
+  setCursor(begin_);
+  return true;
+}
+
+
+void MappedTextFile::close()
+{
+  file_.close();
+  begin_ = end_ = cursor_ = nullptr;
+  points_.clear();
+  next_point_ = 0;
+  failed_ = false;
+}
+
+
+bool MappedTextFile::nextLine(const char *&line_begin, const char *&line_end)
+{
+  if (!cursor_ || cursor_ >= end_)
+  {
+    return false;
+  }
+
+  line_begin = cursor_;
+  line_end = std::find(cursor_, end_, '\n');
+  cursor_ = (line_end < end_) ? line_end + 1 : end_;
+  if (line_end > line_begin && line_end[-1] == '\r')
+  {
+    --line_end;
+  }
+  points_.clear();
+  next_point_ = 0;
+  return true;
+}
+
+
+const char *MappedTextFile::nextLineStart(const char *pos) const
+{
+  if (pos >= end_)
+  {
+    return end_;
+  }
+  const char *line_end = std::find(pos, end_, '\n');
+  return (line_end < end_) ? line_end + 1 : end_;
+}
+}  // namespace slamio
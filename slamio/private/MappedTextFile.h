@@ -0,0 +1,231 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_MAPPEDTEXTFILE_H_
+#define SLAMIO_MAPPEDTEXTFILE_H_
+
+#include "SlamIOConfig.h"
+
+#include "MappedFile.h"
+#include "Points.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace slamio
+{
+/// A read only, memory mapped text file which parses @c CloudPoint items one per line, splitting the file into line
+/// aligned blocks which are parsed in parallel.
+///
+/// The file is memory mapped via @c MappedFile .
+///
+/// Points are parsed using a @c LineParser function object with the following signature, which should return false
+/// if the line is malformed:
+/// @code
+/// bool parse(const char *line_begin, const char *line_end, CloudPoint &point);
+/// @endcode
+///
+/// The parser is invoked concurrently from multiple threads so must not modify shared state. Empty lines are skipped.
+/// Parsing stops at the first malformed line.
+class MappedTextFile
+{
+public:
+  /// Number of bytes parsed by each thread per block.
+  static constexpr size_t kThreadBlockBytes = 4u * 1024u * 1024u;
+
+  MappedTextFile();
+  ~MappedTextFile();
+
+  MappedTextFile(const MappedTextFile &) = delete;
+  MappedTextFile &operator=(const MappedTextFile &) = delete;
+
+  /// Open and map @p filename .
+  /// @param filename The file to open.
+  /// @return True on success.
+  bool open(const char *filename);
+  /// Close the file, releasing the mapping.
+  void close();
+  /// Is the file open?
+  /// @return True if open.
+  inline bool isOpen() const { return file_.isOpen(); }
+
+  /// Read the next line without parsing, advancing the read cursor. Used to read heading lines.
+  /// @param[out] line_begin Set to the start of the line.
+  /// @param[out] line_end Set to the end of the line, excluding line termination characters.
+  /// @return False when at the end of the file.
+  bool nextLine(const char *&line_begin, const char *&line_end);
+
+  /// Query the current read cursor.
+  /// @return The current cursor position in the file.
+  inline const char *cursor() const { return cursor_; }
+  /// Reset the read cursor to a position previously returned by @c cursor() , discarding buffered points.
+  /// @param cursor The new cursor position.
+  inline void setCursor(const char *cursor)
+  {
+    cursor_ = cursor;
+    points_.clear();
+    next_point_ = 0;
+    failed_ = false;
+  }
+
+  /// Read up to @p count points.
+  /// @param[out] points Point array to read into.
+  /// @param count Number of elements in @p points .
+  /// @param parse The line parser.
+  /// @return The number of points read. Less than @p count at the end of the data.
+  template <typename LineParser>
+  uint64_t readPoints(CloudPoint *points, uint64_t count, const LineParser &parse);
+
+private:
+  template <typename LineParser>
+  bool parseBlock(const LineParser &parse);
+
+  /// Find the start of the line following @p pos .
+  const char *nextLineStart(const char *pos) const;
+
+  MappedFile file_;
+  const char *begin_ = nullptr;
+  const char *end_ = nullptr;
+  const char *cursor_ = nullptr;
+  std::vector<CloudPoint> points_;
+  size_t next_point_ = 0;
+  bool failed_ = false;
+};
+
+
+namespace detail
+{
+/// Parse the lines in [@p begin, @p end ) into @p points .
+/// @return False if parsing stopped at a malformed line.
+template <typename LineParser>
+bool parseLines(const char *begin, const char *end, const LineParser &parse, std::vector<CloudPoint> &points)
+{
+  const char *line_begin = begin;
+  while (line_begin < end)
+  {
+    const char *line_end = std::find(line_begin, end, '\n');
+    const char *next = (line_end < end) ? line_end + 1 : end;
+    // Trim trailing carriage return and skip empty lines.
+    while (line_end > line_begin && (line_end[-1] == '\r' || line_end[-1] == ' ' || line_end[-1] == '\t'))
+    {
+      --line_end;
+    }
+    if (line_end > line_begin)
+    {
+      CloudPoint point{};
+      if (!parse(line_begin, line_end, point))
+      {
+        return false;
+      }
+      points.emplace_back(point);
+    }
+    line_begin = next;
+  }
+  return true;
+}
+}  // namespace detail
+
+
+template <typename LineParser>
+uint64_t MappedTextFile::readPoints(CloudPoint *points, uint64_t count, const LineParser &parse)
+{
+  uint64_t read_count = 0;
+  while (read_count < count)
+  {
+    if (next_point_ >= points_.size() && !parseBlock(parse))
+    {
+      break;
+    }
+
+    const auto copy_count = size_t(std::min<uint64_t>(count - read_count, points_.size() - next_point_));
+    std::copy(points_.begin() + next_point_, points_.begin() + next_point_ + copy_count, points + read_count);
+    next_point_ += copy_count;
+    read_count += copy_count;
+  }
+  return read_count;
+}
+
+
+template <typename LineParser>
+bool MappedTextFile::parseBlock(const LineParser &parse)
+{
+  points_.clear();
+  next_point_ = 0;
+
+  while (points_.empty())
+  {
+    if (failed_ || !cursor_ || cursor_ >= end_)
+    {
+      return false;
+    }
+
+    const unsigned thread_count = std::max(1u, std::thread::hardware_concurrency());
+    const size_t remaining = size_t(end_ - cursor_);
+    const size_t block_size = std::min(remaining, size_t(thread_count) * kThreadBlockBytes);
+    const char *block_end = nextLineStart(cursor_ + block_size);
+
+    if (thread_count == 1 || block_size <= kThreadBlockBytes)
+    {
+      failed_ = !detail::parseLines(cursor_, block_end, parse, points_);
+      cursor_ = block_end;
+      continue;
+    }
+
+    // Split into line aligned ranges, one per thread.
+    const size_t range_size = size_t(block_end - cursor_) / thread_count;
+    std::vector<const char *> range_starts(thread_count + 1);
+    range_starts[0] = cursor_;
+    for (unsigned i = 1; i < thread_count; ++i)
+    {
+      range_starts[i] = std::max(range_starts[i - 1], nextLineStart(cursor_ + i * range_size));
+    }
+    range_starts[thread_count] = block_end;
+
+    std::vector<std::vector<CloudPoint>> thread_points(thread_count);
+    std::vector<char> thread_ok(thread_count, 1);
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+      threads.emplace_back([&, i]() {
+        thread_ok[i] = detail::parseLines(range_starts[i], range_starts[i + 1], parse, thread_points[i]);
+      });
+    }
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+
+    // Collate in order, stopping after the first failed range.
+    size_t total = 0;
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+      total += thread_points[i].size();
+      if (!thread_ok[i])
+      {
+        break;
+      }
+    }
+    points_.reserve(total);
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+      points_.insert(points_.end(), thread_points[i].begin(), thread_points[i].end());
+      if (!thread_ok[i])
+      {
+        failed_ = true;
+        break;
+      }
+    }
+    cursor_ = block_end;
+  }
+
+  return true;
+}
+}  // namespace slamio
+
+#endif  // SLAMIO_MAPPEDTEXTFILE_H_
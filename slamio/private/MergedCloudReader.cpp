@@ -0,0 +1,214 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "MergedCloudReader.h"
+
+#include "BoundedQueue.h"
+
+#include <algorithm>
+
+namespace slamio
+{
+struct MergedCloudReader::Input
+{
+  PointCloudReaderPtr reader;
+  BoundedQueue<std::vector<CloudPoint>> chunks;
+  std::thread thread;
+  /// Chunk currently being merged.
+  std::vector<CloudPoint> current;
+  size_t current_index = 0;
+  unsigned index = 0;
+
+  Input(PointCloudReaderPtr reader, unsigned index, size_t queue_depth)
+    : reader(std::move(reader))
+    , chunks(queue_depth)
+    , index(index)
+  {}
+
+  inline const CloudPoint &head() const { return current[current_index]; }
+};
+
+
+MergedCloudReader::MergedCloudReader(std::vector<PointCloudReaderPtr> readers, size_t chunk_size,
+                                     size_t queue_depth)
+{
+  chunk_size = std::max<size_t>(chunk_size, 1u);
+  readers.resize(std::min<size_t>(readers.size(), 256u));
+  for (auto &reader : readers)
+  {
+    desired_channels_ = (inputs_.empty()) ? reader->desiredChannels() : desired_channels_ & reader->desiredChannels();
+    inputs_.emplace_back(std::make_unique<Input>(std::move(reader), unsigned(inputs_.size()), queue_depth));
+  }
+
+  for (auto &input_ptr : inputs_)
+  {
+    Input *input = input_ptr.get();
+    input->thread = std::thread([input, chunk_size]() {
+      for (;;)
+      {
+        std::vector<CloudPoint> chunk(chunk_size);
+        chunk.resize(input->reader->readChunk(chunk.data(), chunk.size()));
+        if (chunk.empty() || !input->chunks.push(std::move(chunk)))
+        {
+          break;
+        }
+      }
+      input->chunks.close();
+    });
+  }
+
+  // Prime the heap.
+  for (auto &input : inputs_)
+  {
+    if (fetch(*input))
+    {
+      heap_.emplace_back(input->index);
+    }
+  }
+  std::make_heap(heap_.begin(), heap_.end(), [this](unsigned a, unsigned b) { return later(a, b); });
+  open_ = true;
+}
+
+
+MergedCloudReader::~MergedCloudReader()
+{
+  close();
+}
+
+
+DataChannel MergedCloudReader::availableChannels() const
+{
+  DataChannel channels = DataChannel::None;
+  for (size_t i = 0; i < inputs_.size(); ++i)
+  {
+    channels = (i == 0) ? inputs_[i]->reader->availableChannels() : channels & inputs_[i]->reader->availableChannels();
+  }
+  return channels;
+}
+
+
+DataChannel MergedCloudReader::desiredChannels() const
+{
+  return desired_channels_;
+}
+
+
+void MergedCloudReader::setDesiredChannels(DataChannel channels)
+{
+  // Input readers are already open, so this has no effect on loading.
+  desired_channels_ = channels;
+}
+
+
+bool MergedCloudReader::isOpen()
+{
+  return open_;
+}
+
+
+bool MergedCloudReader::open(const char *filename)
+{
+  (void)filename;
+  return open_;
+}
+
+
+void MergedCloudReader::close()
+{
+  for (auto &input : inputs_)
+  {
+    input->chunks.close(true);
+  }
+  for (auto &input : inputs_)
+  {
+    if (input->thread.joinable())
+    {
+      input->thread.join();
+    }
+    input->reader->close();
+  }
+  inputs_.clear();
+  heap_.clear();
+  open_ = false;
+}
+
+
+bool MergedCloudReader::streaming() const
+{
+  return true;
+}
+
+
+uint64_t MergedCloudReader::pointCount() const
+{
+  uint64_t count = 0;
+  for (const auto &input : inputs_)
+  {
+    const uint64_t input_count = input->reader->pointCount();
+    if (input_count == 0)
+    {
+      return 0;
+    }
+    count += input_count;
+  }
+  return count;
+}
+
+
+bool MergedCloudReader::readNext(CloudPoint &point)
+{
+  return readChunk(&point, 1) == 1;
+}
+
+
+uint64_t MergedCloudReader::readChunk(CloudPoint *point, uint64_t count)
+{
+  const auto heap_order = [this](unsigned a, unsigned b) { return later(a, b); };
+  uint64_t read_count = 0;
+  while (read_count < count && !heap_.empty())
+  {
+    std::pop_heap(heap_.begin(), heap_.end(), heap_order);
+    Input &input = *inputs_[heap_.back()];
+
+    CloudPoint &pt = point[read_count++];
+    pt = input.head();
+    pt.sensor_index = uint8_t(input.index);
+    ++input.current_index;
+
+    if (fetch(input))
+    {
+      std::push_heap(heap_.begin(), heap_.end(), heap_order);
+    }
+    else
+    {
+      heap_.pop_back();
+    }
+  }
+  return read_count;
+}
+
+
+bool MergedCloudReader::fetch(Input &input)
+{
+  while (input.current_index >= input.current.size())
+  {
+    input.current_index = 0;
+    input.current.clear();
+    if (!input.chunks.pop(input.current))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool MergedCloudReader::later(unsigned a, unsigned b) const
+{
+  const double time_a = inputs_[a]->head().timestamp;
+  const double time_b = inputs_[b]->head().timestamp;
+  return time_a > time_b || (time_a == time_b && a > b);
+}
+}  // namespace slamio
@@ -0,0 +1,76 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_MERGEDCLOUDREADER_H_
+#define SLAMIO_MERGEDCLOUDREADER_H_
+
+#include "SlamIOConfig.h"
+
+#include "PointCloudReader.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace slamio
+{
+template <typename T>
+class BoundedQueue;
+
+/// A @c PointCloudReader which merges points from multiple open readers in timestamp order.
+///
+/// Each input reader is read ahead on its own thread in chunks, connected to the merge by a bounded queue. The merge
+/// selects the input with the earliest next timestamp, breaking ties by input order. Each input must itself be in
+/// timestamp order. Merged points have their @c CloudPoint::sensor_index set to the index of the input reader.
+///
+/// The input readers must be open. The merged reader is open on construction and @c open() only reports whether it
+/// remains open.
+class MergedCloudReader : public PointCloudReader
+{
+public:
+  /// Constructor. Starts the read ahead threads.
+  /// @param readers The open input readers. At most 256 readers are supported.
+  /// @param chunk_size Number of points read ahead in each chunk.
+  /// @param queue_depth Maximum number of chunks read ahead for each input.
+  MergedCloudReader(std::vector<PointCloudReaderPtr> readers, size_t chunk_size, size_t queue_depth);
+  ~MergedCloudReader();
+
+  /// Channels available from all input readers.
+  DataChannel availableChannels() const override;
+  DataChannel desiredChannels() const override;
+  void setDesiredChannels(DataChannel channels) override;
+
+  bool isOpen() override;
+  bool open(const char *filename) override;
+  void close() override;
+
+  bool streaming() const override;
+
+  /// Total point count, or zero if any input count is unknown.
+  uint64_t pointCount() const override;
+  bool readNext(CloudPoint &point) override;
+  uint64_t readChunk(CloudPoint *point, uint64_t count) override;
+
+private:
+  /// Read ahead state for an input reader.
+  struct Input;
+
+  /// Ensure @p input has a current point, fetching the next chunk as required.
+  /// @return False when the input is exhausted.
+  bool fetch(Input &input);
+
+  /// Heap ordering for the @c heap_ , placing the earliest timestamp, then the lowest input index at the front.
+  /// @return True if input @p a should be merged after input @p b .
+  bool later(unsigned a, unsigned b) const;
+
+  std::vector<std::unique_ptr<Input>> inputs_;
+  /// Heap of input indices with a current point, ordered by current timestamp.
+  std::vector<unsigned> heap_;
+  DataChannel desired_channels_ = DataChannel::None;
+  bool open_ = false;
+};
+}  // namespace slamio
+
+#endif  // SLAMIO_MERGEDCLOUDREADER_H_
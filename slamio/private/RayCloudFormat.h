@@ -0,0 +1,86 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_RAYCLOUDFORMAT_H_
+#define SLAMIO_RAYCLOUDFORMAT_H_
+
+#include "SlamIOConfig.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace slamio
+{
+/// Binary ray cloud file structures. See @c RayCloudWriter for the file layout.
+///
+/// All values are stored little endian with no padding between structures.
+namespace raycloud
+{
+/// File marker: "SLRC"
+constexpr uint32_t kMarker = 0x43524c53u;
+/// Current file format version.
+constexpr uint16_t kVersion = 1u;
+
+/// Chunk encoding.
+enum Encoding : uint32_t
+{
+  kEncodingRaw = 0u,  ///< Uncompressed channel data.
+  kEncodingLz4 = 1u   ///< LZ4 block compressed channel data.
+};
+
+/// File header, at the start of the file.
+struct FileHeader
+{
+  uint32_t marker = kMarker;
+  uint16_t version = kVersion;
+  uint16_t flags = 0;
+  /// Number of entries in the chunk table.
+  uint32_t chunk_count = 0;
+  uint32_t reserved = 0;
+  /// Total number of rays in the file.
+  uint64_t ray_count = 0;
+  /// Byte offset to the @c ChunkEntry table. Zero if the file was not closed correctly.
+  uint64_t chunk_table_offset = 0;
+  /// Minimum ray timestamp.
+  double time_min = 0;
+  /// Maximum ray timestamp.
+  double time_max = 0;
+  uint64_t padding[2] = {};
+};
+
+/// Chunk table entry. The table is written after the last chunk and is sorted in file order.
+struct ChunkEntry
+{
+  /// Byte offset to the chunk data.
+  uint64_t offset = 0;
+  /// Stored byte size of the chunk data.
+  uint64_t stored_size = 0;
+  /// Index of the first ray in the chunk.
+  uint64_t first_ray = 0;
+  /// Number of rays in the chunk.
+  uint32_t ray_count = 0;
+  /// Chunk @c Encoding .
+  uint32_t encoding = kEncodingRaw;
+  /// Minimum ray timestamp in the chunk.
+  double time_min = 0;
+  /// Maximum ray timestamp in the chunk.
+  double time_max = 0;
+};
+
+static_assert(sizeof(FileHeader) == 64, "Unexpected FileHeader size");
+static_assert(sizeof(ChunkEntry) == 48, "Unexpected ChunkEntry size");
+
+/// Byte size of each ray across all channels: origin, sample, time, intensity and return number.
+constexpr size_t kRayByteSize = 3 * sizeof(double) + 3 * sizeof(double) + sizeof(double) + sizeof(float) + 1;
+
+/// Byte size of the uncompressed data for a chunk of @p ray_count rays.
+inline size_t chunkByteSize(size_t ray_count)
+{
+  return ray_count * kRayByteSize;
+}
+}  // namespace raycloud
+}  // namespace slamio
+
+#endif  // SLAMIO_RAYCLOUDFORMAT_H_
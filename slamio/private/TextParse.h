@@ -0,0 +1,159 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef SLAMIO_TEXTPARSE_H_
+#define SLAMIO_TEXTPARSE_H_
+
+#include "SlamIOConfig.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace slamio
+{
+namespace text
+{
+/// Is @p ch a value delimiter? Values are separated by white space or commas.
+inline bool isDelimiter(char ch)
+{
+  return ch == ' ' || ch == '\t' || ch == ',' || ch == '\r';
+}
+
+
+/// Skip delimiters from @p cursor .
+/// @return The first non delimiter character or @p end .
+inline const char *skipDelimiters(const char *cursor, const char *end)
+{
+  while (cursor < end && isDelimiter(*cursor))
+  {
+    ++cursor;
+  }
+  return cursor;
+}
+
+
+/// Skip the value token at @p cursor .
+/// @return The first delimiter character after the token or @p end .
+inline const char *skipToken(const char *cursor, const char *end)
+{
+  while (cursor < end && !isDelimiter(*cursor))
+  {
+    ++cursor;
+  }
+  return cursor;
+}
+
+
+/// Parse a floating point value from [@p cursor , @p end ) without requiring null termination.
+///
+/// Decimal values with up to 19 significant digits and a power of ten exponent of magnitude 22 or less - covering
+/// typical point cloud exports - are converted exactly using a single floating point multiply or divide by an exactly
+/// representable power of ten (Clinger's fast path). Other values, including `inf` and `nan`, fall back to
+/// @c std::strtod() .
+///
+/// @param cursor Start of the token. Advanced past the parsed token on success.
+/// @param end End of the available characters.
+/// @param[out] value Set to the parsed value.
+/// @return True on success.
+inline bool parseDouble(const char *&cursor, const char *end, double &value)
+{
+  static const double kPow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+  const char *pos = cursor;
+  bool negative = false;
+  if (pos < end && (*pos == '-' || *pos == '+'))
+  {
+    negative = *pos == '-';
+    ++pos;
+  }
+
+  uint64_t mantissa = 0;
+  int significant_digits = 0;
+  int exponent = 0;
+  bool any_digits = false;
+
+  // Integer part.
+  for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+  {
+    any_digits = true;
+    if (mantissa || *pos != '0')
+    {
+      mantissa = mantissa * 10u + uint64_t(*pos - '0');
+      ++significant_digits;
+    }
+  }
+
+  // Fraction.
+  if (pos < end && *pos == '.')
+  {
+    ++pos;
+    for (; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+    {
+      any_digits = true;
+      if (mantissa || *pos != '0')
+      {
+        mantissa = mantissa * 10u + uint64_t(*pos - '0');
+        ++significant_digits;
+      }
+      --exponent;
+    }
+  }
+
+  // Exponent.
+  if (any_digits && pos < end && (*pos == 'e' || *pos == 'E'))
+  {
+    const char *exp_pos = pos + 1;
+    bool exp_negative = false;
+    if (exp_pos < end && (*exp_pos == '-' || *exp_pos == '+'))
+    {
+      exp_negative = *exp_pos == '-';
+      ++exp_pos;
+    }
+    if (exp_pos < end && *exp_pos >= '0' && *exp_pos <= '9')
+    {
+      int exp_value = 0;
+      for (; exp_pos < end && *exp_pos >= '0' && *exp_pos <= '9'; ++exp_pos)
+      {
+        exp_value = (exp_value < 10000) ? exp_value * 10 + (*exp_pos - '0') : exp_value;
+      }
+      exponent += (exp_negative) ? -exp_value : exp_value;
+      pos = exp_pos;
+    }
+  }
+
+  const bool terminated = pos == end || isDelimiter(*pos);
+  const uint64_t kMaxExactMantissa = uint64_t(1) << 53u;
+  if (any_digits && terminated && significant_digits <= 19 && mantissa <= kMaxExactMantissa && exponent >= -22 &&
+      exponent <= 22)
+  {
+    const double magnitude =
+      (exponent < 0) ? double(mantissa) / kPow10[-exponent] : double(mantissa) * kPow10[exponent];
+    value = (negative) ? -magnitude : magnitude;
+    cursor = pos;
+    return true;
+  }
+
+  // Slow path: copy the token for null termination and use strtod.
+  const char *token_end = skipToken(cursor, end);
+  if (token_end == cursor)
+  {
+    return false;
+  }
+  const std::string token(cursor, token_end);
+  char *parse_end = nullptr;
+  value = std::strtod(token.c_str(), &parse_end);
+  if (parse_end != token.c_str() + token.size())
+  {
+    return false;
+  }
+  cursor = token_end;
+  return true;
+}
+}  // namespace text
+}  // namespace slamio
+
+#endif  // SLAMIO_TEXTPARSE_H_
@@ -0,0 +1,118 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "BenchData.h"
+
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+
+#include <slamio/SlamCloudLoader.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+
+namespace ohmbench
+{
+namespace
+{
+struct RayData
+{
+  std::vector<glm::dvec3> rays;
+  std::string source = "synthetic";
+
+  RayData()
+  {
+    const char *cloud_file = std::getenv("OHM_BENCH_CLOUD");
+    if (!cloud_file || !loadRecorded(cloud_file))
+    {
+      generateSynthetic();
+    }
+  }
+
+  bool loadRecorded(const char *cloud_file)
+  {
+    const char *trajectory_file = std::getenv("OHM_BENCH_TRAJECTORY");
+    const char *limit_str = std::getenv("OHM_BENCH_RAY_LIMIT");
+    const size_t ray_limit = (limit_str) ? std::strtoull(limit_str, nullptr, 10) : 1000000u;
+
+    slamio::SlamCloudLoader loader;
+    const bool opened = (trajectory_file) ? loader.openWithTrajectory(cloud_file, trajectory_file) :
+                                            loader.openRayCloud(cloud_file);
+    if (!opened)
+    {
+      std::cerr << "Failed to open benchmark cloud " << cloud_file << ". Using synthetic rays." << std::endl;
+      return false;
+    }
+
+    slamio::SamplePoint sample{};
+    while ((ray_limit == 0 || rays.size() / 2 < ray_limit) && loader.nextSample(sample))
+    {
+      rays.emplace_back(sample.origin);
+      rays.emplace_back(sample.sample);
+    }
+
+    source = cloud_file;
+    return !rays.empty();
+  }
+
+  void generateSynthetic()
+  {
+    // Rays from a short trajectory across a flattened volume loosely approximating a lidar scan.
+    const size_t ray_count = 200000u;
+    std::mt19937 rng(1234u);
+    std::uniform_real_distribution<double> rand(-15.0, 15.0);
+    rays.clear();
+    rays.reserve(2 * ray_count);
+    for (size_t i = 0; i < ray_count; ++i)
+    {
+      const double t = double(i) / double(ray_count);
+      const glm::dvec3 origin(5.0 * t, 0.0, 0.5);
+      rays.emplace_back(origin);
+      rays.emplace_back(origin + glm::dvec3(rand(rng), rand(rng), 0.1 * rand(rng)));
+    }
+  }
+};
+
+
+RayData &rayData()
+{
+  static RayData data;
+  return data;
+}
+}  // namespace
+
+
+const std::vector<glm::dvec3> &rays()
+{
+  return rayData().rays;
+}
+
+
+const std::string &raySource()
+{
+  return rayData().source;
+}
+
+
+void populate(ohm::OccupancyMap &map)
+{
+  ohm::RayMapperOccupancy mapper(&map);
+  const std::vector<glm::dvec3> &ray_set = rays();
+  mapper.integrateRays(ray_set.data(), ray_set.size());
+}
+
+
+const ohm::OccupancyMap &populatedMap()
+{
+  static const std::unique_ptr<ohm::OccupancyMap> map = []() {
+    auto new_map = std::make_unique<ohm::OccupancyMap>(kResolution);
+    populate(*new_map);
+    return new_map;
+  }();
+  return *map;
+}
+}  // namespace ohmbench
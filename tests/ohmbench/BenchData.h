@@ -0,0 +1,52 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMBENCH_BENCHDATA_H
+#define OHMBENCH_BENCHDATA_H
+
+#include <glm/vec3.hpp>
+
+#include <string>
+#include <vector>
+
+namespace ohm
+{
+class OccupancyMap;
+}  // namespace ohm
+
+/// Shared input data for the ohm benchmarks.
+///
+/// Benchmarks run on synthetic rays by default, generated with a fixed seed so results are reproducible. Recorded data
+/// may be used instead by setting the following environment variables:
+/// - @c OHM_BENCH_CLOUD : point cloud file to load with @c slamio::SlamCloudLoader .
+/// - @c OHM_BENCH_TRAJECTORY : optional trajectory file for @c OHM_BENCH_CLOUD . Without a trajectory the cloud is
+///   loaded as a ray cloud.
+/// - @c OHM_BENCH_RAY_LIMIT : maximum number of rays to load from @c OHM_BENCH_CLOUD . Defaults to 1000000.
+///
+/// Use `--benchmark_out=<file> --benchmark_out_format=json` or the @c ohmbench_json build target to write results
+/// as JSON for regression tracking.
+namespace ohmbench
+{
+/// Voxel resolution used for benchmark maps.
+constexpr double kResolution = 0.1;
+
+/// Access the benchmark ray set as origin/sample pairs. Loaded on first call.
+/// @return The benchmark rays.
+const std::vector<glm::dvec3> &rays();
+
+/// Describes the source of @c rays() : "synthetic" or the recorded cloud file name.
+/// @return The ray source label.
+const std::string &raySource();
+
+/// Populate @p map by integrating @c rays() using a @c RayMapperOccupancy .
+/// @param map The map to populate.
+void populate(ohm::OccupancyMap &map);
+
+/// Access a shared occupancy map populated with @c rays() . Generated on first call.
+/// @return The shared benchmark map.
+const ohm::OccupancyMap &populatedMap();
+}  // namespace ohmbench
+
+#endif  // OHMBENCH_BENCHDATA_H
@@ -0,0 +1,212 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Benchmark comparing VoxelBlock compression ratio against compression and decompression throughput for each
+// compression type and the occupancy, mean and covariance layers.
+//
+// Each benchmark reports:
+// - ratio : uncompressed/compressed size
+// - compress_MBps : compression throughput in uncompressed MB per second
+// - decompress_MBps : decompression throughput in uncompressed MB per second
+
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/NdtMap.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperNdt.h>
+#include <ohm/VoxelBlock.h>
+
+#include <benchmark/benchmark.h>
+
+#include <glm/vec3.hpp>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+using Clock = std::chrono::high_resolution_clock;
+
+enum BenchLayer : int
+{
+  kBlOccupancy,
+  kBlMean,
+  kBlCovariance,
+  kBlCount
+};
+
+/// Benchmark codec. Mostly maps to @c VoxelBlock::CompressionType with the addition of Zstd with a dictionary.
+enum BenchCodec : int
+{
+  kBcDeflate,
+  kBcGZip,
+  kBcLz4,
+  kBcZstd,
+  kBcZstdDictionary
+};
+
+const size_t kDictionarySize = 16 * 1024u;
+
+/// Shared map data for the benchmarks. Generated on first use.
+struct BenchData
+{
+  std::unique_ptr<ohm::OccupancyMap> map;
+  std::vector<const ohm::MapChunk *> chunks;
+  int layers[kBlCount] = {};
+  std::shared_ptr<std::vector<uint8_t>> dictionaries[kBlCount];
+
+  BenchData()
+  {
+    map = std::make_unique<ohm::OccupancyMap>(0.1, ohm::MapFlag::kNone);
+    ohm::NdtMap ndt(map.get(), true);
+    ohm::RayMapperNdt mapper(&ndt);
+
+    // Rays from the origin across a flattened volume loosely approximating a lidar scan.
+    const size_t ray_count = 100000u;
+    std::mt19937 rng(1234u);
+    std::uniform_real_distribution<double> rand(-15.0, 15.0);
+    std::vector<glm::dvec3> rays;
+    rays.reserve(2 * ray_count);
+    for (size_t i = 0; i < ray_count; ++i)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(rand(rng), rand(rng), 0.1 * rand(rng)));
+    }
+    mapper.integrateRays(rays.data(), rays.size());
+
+    map->enumerateRegions(chunks);
+    layers[kBlOccupancy] = map->layout().occupancyLayer();
+    layers[kBlMean] = map->layout().meanLayer();
+    layers[kBlCovariance] = map->layout().covarianceLayer();
+
+    for (int i = 0; i < kBlCount; ++i)
+    {
+      auto dictionary = std::make_shared<std::vector<uint8_t>>();
+      if (ohm::VoxelBlock::trainCompressionDictionary(blocks(BenchLayer(i)), kDictionarySize, *dictionary))
+      {
+        dictionaries[i] = dictionary;
+      }
+    }
+  }
+
+  std::vector<ohm::VoxelBlock *> blocks(BenchLayer layer) const
+  {
+    std::vector<ohm::VoxelBlock *> layer_blocks;
+    layer_blocks.reserve(chunks.size());
+    for (const ohm::MapChunk *chunk : chunks)
+    {
+      layer_blocks.emplace_back(chunk->voxel_blocks[layers[layer]].get());
+    }
+    return layer_blocks;
+  }
+};
+
+BenchData &benchData()
+{
+  static BenchData data;
+  return data;
+}
+
+void compressionBenchmark(benchmark::State &state)
+{
+  BenchData &data = benchData();
+  const auto layer = BenchLayer(state.range(0));
+  const auto codec = BenchCodec(state.range(1));
+  const auto level = ohm::VoxelBlock::CompressionLevel(state.range(2));
+
+  ohm::VoxelBlock::CompressionControls restore_controls;
+  ohm::VoxelBlock::getCompressionControls(&restore_controls);
+
+  ohm::VoxelBlock::CompressionControls controls;
+  controls.compression_level = level;
+  switch (codec)
+  {
+  case kBcDeflate:
+    controls.compression_type = ohm::VoxelBlock::kCompressDeflate;
+    break;
+  case kBcGZip:
+    controls.compression_type = ohm::VoxelBlock::kCompressGZip;
+    break;
+  case kBcLz4:
+    controls.compression_type = ohm::VoxelBlock::kCompressLz4;
+    break;
+  case kBcZstd:
+    controls.compression_type = ohm::VoxelBlock::kCompressZstd;
+    break;
+  case kBcZstdDictionary:
+    controls.compression_type = ohm::VoxelBlock::kCompressZstd;
+    controls.dictionary = data.dictionaries[layer];
+    if (!controls.dictionary)
+    {
+      state.SkipWithError("Dictionary unavailable");
+      return;
+    }
+    break;
+  }
+
+  if (!ohm::VoxelBlock::compressionTypeSupported(controls.compression_type))
+  {
+    state.SkipWithError("Compression type not supported in this build");
+    return;
+  }
+
+  ohm::VoxelBlock::setCompressionControls(controls);
+
+  const std::vector<ohm::VoxelBlock *> blocks = data.blocks(layer);
+  std::vector<uint8_t> compression_buffer;
+  size_t uncompressed_bytes = 0;
+  size_t compressed_bytes = 0;
+  Clock::duration compress_time{};
+  Clock::duration decompress_time{};
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    auto start = Clock::now();
+    for (ohm::VoxelBlock *block : blocks)
+    {
+      compressed_bytes += block->compressWithTemporaryBuffer(compression_buffer);
+      uncompressed_bytes += block->uncompressedByteSize();
+    }
+    compress_time += Clock::now() - start;
+
+    start = Clock::now();
+    for (ohm::VoxelBlock *block : blocks)
+    {
+      block->retain();
+      benchmark::DoNotOptimize(block->voxelBytes());
+      block->release();
+    }
+    decompress_time += Clock::now() - start;
+  }
+
+  ohm::VoxelBlock::setCompressionControls(restore_controls);
+
+  const double megabytes = double(uncompressed_bytes) * 1e-6;
+  state.SetBytesProcessed(int64_t(uncompressed_bytes));
+  state.counters["ratio"] = (compressed_bytes) ? double(uncompressed_bytes) / double(compressed_bytes) : 0.0;
+  state.counters["compress_MBps"] = megabytes / std::chrono::duration<double>(compress_time).count();
+  state.counters["decompress_MBps"] = megabytes / std::chrono::duration<double>(decompress_time).count();
+}
+
+void compressionArgs(benchmark::internal::Benchmark *bench)
+{
+  bench->ArgNames({ "layer", "codec", "level" });
+  for (int layer = 0; layer < kBlCount; ++layer)
+  {
+    for (int codec = kBcDeflate; codec <= kBcZstdDictionary; ++codec)
+    {
+      for (int level = ohm::VoxelBlock::kCompressFast; level <= ohm::VoxelBlock::kCompressMax; ++level)
+      {
+        bench->Args({ layer, codec, level });
+      }
+    }
+  }
+}
+}  // namespace
+
+BENCHMARK(compressionBenchmark)->Apply(compressionArgs)->Unit(benchmark::kMillisecond);
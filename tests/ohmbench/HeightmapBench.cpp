@@ -0,0 +1,41 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Benchmark for heightmap generation from a map populated from the benchmark rays.
+
+#include "BenchData.h"
+
+#include <ohmheightmap/Heightmap.h>
+
+#include <ohm/OccupancyMap.h>
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+void heightmapBenchmark(benchmark::State &state)
+{
+  const ohm::OccupancyMap &map = ohmbench::populatedMap();
+  const double clearance = 0.5;
+
+  ohm::Heightmap heightmap(map.resolution(), clearance);
+  heightmap.setOccupancyMap(&map);
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    if (!heightmap.buildHeightmap(glm::dvec3(0.0)))
+    {
+      state.SkipWithError("Heightmap generation failed");
+      break;
+    }
+  }
+
+  state.counters["heightmap_regions"] = double(heightmap.heightmap().regionCount());
+  state.SetLabel(ohmbench::raySource());
+}
+}  // namespace
+
+BENCHMARK(heightmapBenchmark)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,137 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Benchmarks for map access, queries and serialisation on a map populated from the benchmark rays.
+
+#include "BenchData.h"
+
+#include <ohm/MapChunk.h>
+#include <ohm/MapSerialise.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RaysQuery.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+void regionLookupBenchmark(benchmark::State &state)
+{
+  const ohm::OccupancyMap &map = ohmbench::populatedMap();
+
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  if (chunks.empty())
+  {
+    state.SkipWithError("No regions");
+    return;
+  }
+
+  // Look up existing regions in a shuffled order.
+  std::vector<glm::i16vec3> region_keys;
+  region_keys.reserve(chunks.size());
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    region_keys.emplace_back(chunk->region.coord);
+  }
+  std::mt19937 rng(1234u);
+  std::shuffle(region_keys.begin(), region_keys.end(), rng);
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    for (const auto &region_key : region_keys)
+    {
+      benchmark::DoNotOptimize(map.region(region_key));
+    }
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(region_keys.size()));
+  state.SetLabel(ohmbench::raySource());
+}
+
+
+void raysQueryBenchmark(benchmark::State &state)
+{
+  const ohm::OccupancyMap &map = ohmbench::populatedMap();
+  const std::vector<glm::dvec3> &rays = ohmbench::rays();
+
+  ohm::RaysQuery query;
+  // RaysQuery does not modify the map.
+  query.setMap(const_cast<ohm::OccupancyMap *>(&map));  // NOLINT(cppcoreguidelines-pro-type-const-cast)
+  query.setRays(rays);
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    query.reset(false);
+    query.execute();
+    benchmark::DoNotOptimize(query.numberOfResults());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(rays.size() / 2));
+  state.SetLabel(ohmbench::raySource());
+}
+
+
+void serialiseBenchmark(benchmark::State &state)
+{
+  const ohm::OccupancyMap &map = ohmbench::populatedMap();
+  const bool indexed = state.range(0) != 0;
+  const std::string map_file = (indexed) ? "ohmbench-indexed.ohm" : "ohmbench.ohm";
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    const int err = (indexed) ? ohm::saveIndexed(map_file, map) : ohm::save(map_file, map);
+    if (err)
+    {
+      state.SkipWithError("Save failed");
+      break;
+    }
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(map.regionCount()));
+  state.SetLabel(ohmbench::raySource());
+  std::remove(map_file.c_str());
+}
+
+
+void loadBenchmark(benchmark::State &state)
+{
+  const ohm::OccupancyMap &map = ohmbench::populatedMap();
+  const bool indexed = state.range(0) != 0;
+  const std::string map_file = (indexed) ? "ohmbench-load-indexed.ohm" : "ohmbench-load.ohm";
+
+  if ((indexed) ? ohm::saveIndexed(map_file, map) : ohm::save(map_file, map))
+  {
+    state.SkipWithError("Save failed");
+    return;
+  }
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    ohm::OccupancyMap loaded_map;
+    if (ohm::load(map_file, loaded_map))
+    {
+      state.SkipWithError("Load failed");
+      break;
+    }
+    benchmark::DoNotOptimize(loaded_map.regionCount());
+  }
+
+  state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(map.regionCount()));
+  state.SetLabel(ohmbench::raySource());
+  std::remove(map_file.c_str());
+}
+}  // namespace
+
+BENCHMARK(regionLookupBenchmark)->Unit(benchmark::kMicrosecond);
+BENCHMARK(raysQueryBenchmark)->Unit(benchmark::kMillisecond);
+BENCHMARK(serialiseBenchmark)->ArgName("indexed")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(loadBenchmark)->ArgName("indexed")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,217 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Benchmarks reporting the memory footprint and heap allocations of CPU ray integration, by subsystem.
+//
+// Rays are integrated in batches into a new map - the cold pass, which creates the map regions - then integrated again
+// over the existing regions - the warm pass. Memory is sampled after each batch.
+//
+// Each benchmark reports:
+// - host_peak_bytes, host_steady_bytes : total map voxel memory ( MapMemoryAccounting ) at the peak and after the
+//   warm pass.
+// - <layer>_peak_bytes, <layer>_steady_bytes : the same for each map layer.
+// - <subsystem>_peak_bytes, <subsystem>_steady_bytes, <subsystem>_allocs_per_ray : the working memory of the
+//   ohm::memorytrack subsystems; compression buffers, GPU staging and KeyList storage.
+// - allocs_per_ray_cold, allocs_per_ray_warm : heap allocations per integrated ray for each pass.
+//
+// The subsystem and heap allocation counters require building with OHM_MEMORY_TRACK, which enables
+// ohm::memorytrack and counts operator new calls via leak_track_count_allocations(). Otherwise they report zero.
+// The budget argument sets a map memory budget (MiB) which forces compression, exercising the compression buffers.
+
+#include "BenchData.h"
+
+#include <ohm/MapLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapMemoryAccounting.h>
+#include <ohm/MemoryTrack.h>
+#include <ohm/NdtMap.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperNdt.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/RayMapperTsdf.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef LEAK_TRACK_COUNT_ALLOCATIONS
+extern "C" void leak_track_allocation_counts(unsigned long long *count, unsigned long long *bytes);
+#endif  // LEAK_TRACK_COUNT_ALLOCATIONS
+
+namespace
+{
+/// Ray mappers under test.
+enum BenchMapper : int
+{
+  kBmOccupancy,
+  kBmNdt,
+  kBmTsdf
+};
+
+const unsigned kSubsystemCount = unsigned(ohm::MemorySubsystem::kCount);
+/// Number of batches the rays are integrated in for each pass.
+const size_t kBatchCount = 16;
+
+/// Query the number of heap allocations made so far, or zero when not counting allocations.
+uint64_t heapAllocations()
+{
+#ifdef LEAK_TRACK_COUNT_ALLOCATIONS
+  unsigned long long count = 0;
+  leak_track_allocation_counts(&count, nullptr);
+  return count;
+#else   // LEAK_TRACK_COUNT_ALLOCATIONS
+  return 0;
+#endif  // LEAK_TRACK_COUNT_ALLOCATIONS
+}
+
+/// Peak and most recent memory samples.
+struct MemoryProfile
+{
+  std::vector<std::string> layer_names;
+  std::vector<size_t> layer_peak;
+  std::vector<size_t> layer_current;
+  size_t host_peak = 0;
+  size_t host_current = 0;
+  std::array<size_t, kSubsystemCount> subsystem_peak{};
+  std::array<size_t, kSubsystemCount> subsystem_current{};
+  std::array<uint64_t, kSubsystemCount> subsystem_allocations{};
+
+  void sample(const ohm::OccupancyMap &map)
+  {
+    const ohm::MapMemoryUsage usage = map.memoryUsage();
+    layer_names.resize(usage.layers.size());
+    layer_peak.resize(usage.layers.size(), 0u);
+    layer_current.resize(usage.layers.size(), 0u);
+    for (size_t i = 0; i < usage.layers.size(); ++i)
+    {
+      layer_names[i] = map.layout().layer(i).name();
+      layer_current[i] = usage.layers[i].uncompressed_bytes + usage.layers[i].compressed_bytes;
+      layer_peak[i] = std::max(layer_peak[i], layer_current[i]);
+    }
+    host_current = usage.hostBytes();
+    host_peak = std::max(host_peak, host_current);
+
+    // The subsystem peaks are tracked continuously; see memorytrack::resetPeaks().
+    for (unsigned i = 0; i < kSubsystemCount; ++i)
+    {
+      const ohm::MemorySubsystemStats stats = ohm::memorytrack::stats(ohm::MemorySubsystem(i));
+      subsystem_current[i] = stats.current_bytes;
+      subsystem_peak[i] = std::max(subsystem_peak[i], stats.peak_bytes);
+    }
+  }
+};
+
+benchmark::Counter byteCounter(size_t bytes)
+{
+  return benchmark::Counter(double(bytes), benchmark::Counter::kDefault, benchmark::Counter::kIs1024);
+}
+
+/// Integrate @c ohmbench::rays() using @p mapper in @c kBatchCount batches, sampling @p profile after each batch.
+void integrateBatches(ohm::RayMapper &mapper, const ohm::OccupancyMap &map, MemoryProfile &profile)
+{
+  const std::vector<glm::dvec3> &rays = ohmbench::rays();
+  const size_t ray_count = rays.size() / 2;
+  const size_t batch_size = std::max<size_t>(1u, (ray_count + kBatchCount - 1) / kBatchCount);
+  for (size_t begin = 0; begin < ray_count; begin += batch_size)
+  {
+    const size_t end = std::min(begin + batch_size, ray_count);
+    benchmark::DoNotOptimize(mapper.integrateRays(rays.data() + 2 * begin, 2 * (end - begin)));
+    profile.sample(map);
+  }
+}
+
+
+void memoryRayMapperBenchmark(benchmark::State &state)
+{
+  const size_t ray_count = ohmbench::rays().size() / 2;
+  const auto mapper_type = BenchMapper(state.range(0));
+  const size_t budget = size_t(state.range(1)) * 1024u * 1024u;
+
+  MemoryProfile profile;
+  uint64_t cold_allocations = 0;
+  uint64_t warm_allocations = 0;
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    state.PauseTiming();
+    std::unique_ptr<ohm::OccupancyMap> map;
+    std::unique_ptr<ohm::NdtMap> ndt;
+    std::unique_ptr<ohm::RayMapper> mapper;
+    switch (mapper_type)
+    {
+    case kBmOccupancy:
+      map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution, ohm::MapFlag::kCompressed);
+      mapper = std::make_unique<ohm::RayMapperOccupancy>(map.get());
+      break;
+    case kBmNdt:
+      map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution,
+                                                ohm::MapFlag::kVoxelMean | ohm::MapFlag::kCompressed);
+      ndt = std::make_unique<ohm::NdtMap>(map.get(), true);
+      mapper = std::make_unique<ohm::RayMapperNdt>(ndt.get());
+      break;
+    case kBmTsdf:
+      map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution, ohm::MapFlag::kTsdf | ohm::MapFlag::kCompressed);
+      mapper = std::make_unique<ohm::RayMapperTsdf>(map.get());
+      break;
+    }
+    map->setMemoryBudget(budget);
+    ohm::memorytrack::resetPeaks();
+    ohm::memorytrack::resetCounts();
+    state.ResumeTiming();
+
+    const uint64_t cold_start = heapAllocations();
+    integrateBatches(*mapper, *map, profile);
+    const uint64_t warm_start = heapAllocations();
+    integrateBatches(*mapper, *map, profile);
+    const uint64_t warm_end = heapAllocations();
+    cold_allocations += warm_start - cold_start;
+    warm_allocations += warm_end - warm_start;
+
+    state.PauseTiming();
+    for (unsigned i = 0; i < kSubsystemCount; ++i)
+    {
+      profile.subsystem_allocations[i] += ohm::memorytrack::stats(ohm::MemorySubsystem(i)).allocations;
+    }
+    mapper.reset();
+    ndt.reset();
+    map.reset();
+    state.ResumeTiming();
+  }
+
+  const auto total_rays = double(int64_t(state.iterations()) * int64_t(ray_count));
+  state.SetItemsProcessed(int64_t(2 * total_rays));
+  state.counters["allocs_per_ray_cold"] = benchmark::Counter(double(cold_allocations) / total_rays);
+  state.counters["allocs_per_ray_warm"] = benchmark::Counter(double(warm_allocations) / total_rays);
+  state.counters["host_peak_bytes"] = byteCounter(profile.host_peak);
+  state.counters["host_steady_bytes"] = byteCounter(profile.host_current);
+  for (size_t i = 0; i < profile.layer_names.size(); ++i)
+  {
+    state.counters[profile.layer_names[i] + "_peak_bytes"] = byteCounter(profile.layer_peak[i]);
+    state.counters[profile.layer_names[i] + "_steady_bytes"] = byteCounter(profile.layer_current[i]);
+  }
+  for (unsigned i = 0; i < kSubsystemCount; ++i)
+  {
+    const std::string name = ohm::memorytrack::subsystemName(ohm::MemorySubsystem(i));
+    state.counters[name + "_peak_bytes"] = byteCounter(profile.subsystem_peak[i]);
+    state.counters[name + "_steady_bytes"] = byteCounter(profile.subsystem_current[i]);
+    state.counters[name + "_allocs_per_ray"] =
+      benchmark::Counter(double(profile.subsystem_allocations[i]) / (2.0 * total_rays));
+  }
+  state.SetLabel(ohmbench::raySource() + (ohm::memorytrack::kEnabled ? "" : " (memory tracking disabled)"));
+}
+}  // namespace
+
+BENCHMARK(memoryRayMapperBenchmark)
+  ->ArgNames({ "mapper", "budget_mib" })
+  ->Args({ kBmOccupancy, 0 })
+  ->Args({ kBmOccupancy, 16 })  // NOLINT(readability-magic-numbers)
+  ->Args({ kBmNdt, 0 })
+  ->Args({ kBmNdt, 16 })  // NOLINT(readability-magic-numbers)
+  ->Args({ kBmTsdf, 0 })
+  ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,166 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Benchmarks for the voxel traversal and CPU ray integration hot paths.
+//
+// Each benchmark reports:
+// - rays_per_second : rays traced or integrated per second.
+// - voxels_per_second : voxels visited per second (walkSegmentKeys only).
+//
+// rayMapperOccupancyLayersBenchmark covers the MapFlag layer combinations which select the specialised
+// RayMapperOccupancy voxel updates.
+
+#include "BenchData.h"
+
+#include <ohm/Key.h>
+#include <ohm/LineWalk.h>
+#include <ohm/NdtMap.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperNdt.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/RayMapperTsdf.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+/// Ray mappers under test.
+enum BenchMapper : int
+{
+  kBmOccupancy,
+  kBmNdt,
+  kBmTsdf
+};
+
+void walkSegmentKeysBenchmark(benchmark::State &state)
+{
+  const std::vector<glm::dvec3> &rays = ohmbench::rays();
+  ohm::OccupancyMap map(ohmbench::kResolution);
+
+  size_t voxel_count = 0;
+  const ohm::LineWalkContext context(map, [&voxel_count](const ohm::Key &key, double, double) {
+    benchmark::DoNotOptimize(key);
+    ++voxel_count;
+    return true;
+  });
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    for (size_t i = 0; i < rays.size(); i += 2)
+    {
+      ohm::walkSegmentKeys(context, rays[i], rays[i + 1]);
+    }
+  }
+
+  const auto ray_count = int64_t(state.iterations()) * int64_t(rays.size() / 2);
+  state.SetItemsProcessed(ray_count);
+  state.counters["rays_per_second"] = benchmark::Counter(double(ray_count), benchmark::Counter::kIsRate);
+  state.counters["voxels_per_second"] = benchmark::Counter(double(voxel_count), benchmark::Counter::kIsRate);
+  state.SetLabel(ohmbench::raySource());
+}
+
+
+void rayMapperBenchmark(benchmark::State &state)
+{
+  const std::vector<glm::dvec3> &rays = ohmbench::rays();
+  const auto mapper_type = BenchMapper(state.range(0));
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    // Integrate into a new map each iteration so the timing covers region creation as it would for a new scan area.
+    state.PauseTiming();
+    std::unique_ptr<ohm::OccupancyMap> map;
+    std::unique_ptr<ohm::NdtMap> ndt;
+    std::unique_ptr<ohm::RayMapper> mapper;
+    switch (mapper_type)
+    {
+    case kBmOccupancy:
+      map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution);
+      mapper = std::make_unique<ohm::RayMapperOccupancy>(map.get());
+      break;
+    case kBmNdt:
+      map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution, ohm::MapFlag::kVoxelMean);
+      ndt = std::make_unique<ohm::NdtMap>(map.get(), true);
+      mapper = std::make_unique<ohm::RayMapperNdt>(ndt.get());
+      break;
+    case kBmTsdf:
+      map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution, ohm::MapFlag::kTsdf);
+      mapper = std::make_unique<ohm::RayMapperTsdf>(map.get());
+      break;
+    }
+    state.ResumeTiming();
+
+    benchmark::DoNotOptimize(mapper->integrateRays(rays.data(), rays.size()));
+
+    state.PauseTiming();
+    mapper.reset();
+    ndt.reset();
+    map.reset();
+    state.ResumeTiming();
+  }
+
+  const auto ray_count = int64_t(state.iterations()) * int64_t(rays.size() / 2);
+  state.SetItemsProcessed(ray_count);
+  state.counters["rays_per_second"] = benchmark::Counter(double(ray_count), benchmark::Counter::kIsRate);
+  state.SetLabel(ohmbench::raySource());
+}
+
+
+void rayMapperOccupancyLayersBenchmark(benchmark::State &state)
+{
+  const std::vector<glm::dvec3> &rays = ohmbench::rays();
+  const auto map_flags = ohm::MapFlag(state.range(0));
+
+  // Timestamps are required to update the touch time layers.
+  std::vector<double> timestamps(rays.size() / 2);
+  for (size_t i = 0; i < timestamps.size(); ++i)
+  {
+    timestamps[i] = 1e-5 * double(i);  // NOLINT(readability-magic-numbers)
+  }
+
+  for (auto _ : state)  // NOLINT(clang-analyzer-deadcode.DeadStores)
+  {
+    state.PauseTiming();
+    auto map = std::make_unique<ohm::OccupancyMap>(ohmbench::kResolution, map_flags);
+    auto mapper = std::make_unique<ohm::RayMapperOccupancy>(map.get());
+    state.ResumeTiming();
+
+    benchmark::DoNotOptimize(
+      mapper->integrateRays(rays.data(), rays.size(), nullptr, timestamps.data(), ohm::kRfDefault));
+
+    state.PauseTiming();
+    mapper.reset();
+    map.reset();
+    state.ResumeTiming();
+  }
+
+  const auto ray_count = int64_t(state.iterations()) * int64_t(rays.size() / 2);
+  state.SetItemsProcessed(ray_count);
+  state.counters["rays_per_second"] = benchmark::Counter(double(ray_count), benchmark::Counter::kIsRate);
+  state.SetLabel(ohmbench::raySource());
+}
+}  // namespace
+
+BENCHMARK(walkSegmentKeysBenchmark)->Unit(benchmark::kMillisecond);
+BENCHMARK(rayMapperBenchmark)
+  ->ArgName("mapper")
+  ->Arg(kBmOccupancy)
+  ->Arg(kBmNdt)
+  ->Arg(kBmTsdf)
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(rayMapperOccupancyLayersBenchmark)
+  ->ArgName("map_flags")
+  ->Arg(int(ohm::MapFlag::kNone))
+  ->Arg(int(ohm::MapFlag::kVoxelMean))
+  ->Arg(int(ohm::MapFlag::kVoxelMean | ohm::MapFlag::kTraversal))
+  ->Arg(int(ohm::MapFlag::kVoxelMean | ohm::MapFlag::kTouchTime | ohm::MapFlag::kIncidentNormal))
+  ->Arg(int(ohm::MapFlag::kVoxelMean | ohm::MapFlag::kTouchIncident))
+  ->Arg(int(ohm::MapFlag::kVoxelMean | ohm::MapFlag::kTraversal | ohm::MapFlag::kTouchTime |
+            ohm::MapFlag::kIncidentNormal | ohm::MapFlag::kOccupancyState))
+  ->Unit(benchmark::kMillisecond);
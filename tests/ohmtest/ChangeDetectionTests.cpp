@@ -0,0 +1,122 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohm/CompareMaps.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+namespace changedetectiontests
+{
+/// Build a map observing a wall at x = 1.05 from near the origin.
+void buildPrior(ohm::OccupancyMap &map)
+{
+  std::vector<glm::dvec3> rays;
+  for (double y = -0.45; y < 0.5; y += 0.1)
+  {
+    for (double z = -0.45; z < 0.5; z += 0.1)
+    {
+      rays.emplace_back(glm::dvec3(0.05, 0.05, 0.05));
+      rays.emplace_back(glm::dvec3(1.05, y, z));
+    }
+  }
+  ohm::RayMapperOccupancy(&map).integrateRays(rays.data(), rays.size());
+}
+
+
+TEST(ChangeDetection, Changes)
+{
+  ohm::OccupancyMap prior(0.1, glm::u8vec3(16));
+  buildPrior(prior);
+
+  // Identical maps.
+  std::unique_ptr<ohm::OccupancyMap> live(prior.clone());
+  ohm::compare::ChangesResult result = ohm::compare::detectChanges(*live, prior);
+  ASSERT_TRUE(result);
+  EXPECT_TRUE(result.changes.empty());
+  EXPECT_EQ(result.regions_compared, live->regionCount());
+  EXPECT_EQ(result.regions_skipped, result.regions_compared);
+
+  const uint64_t since_stamp = live->stamp();
+
+  // A new obstacle in free space.
+  const ohm::Key obstacle[] = { live->voxelKey(glm::dvec3(0.45, 0.05, 0.05)),
+                                live->voxelKey(glm::dvec3(0.55, 0.05, 0.05)),
+                                live->voxelKey(glm::dvec3(0.65, 0.05, 0.05)) };
+  for (const ohm::Key &key : obstacle)
+  {
+    ASSERT_TRUE(ohm::isFree(ohm::Voxel<const float>(&prior, prior.layout().occupancyLayer(), key)));
+    for (int i = 0; i < 10; ++i)
+    {
+      ohm::integrateHit(*live, key);
+    }
+  }
+
+  // Part of the wall removed.
+  const ohm::Key removed = live->voxelKey(glm::dvec3(1.05, -0.45, -0.45));
+  ASSERT_TRUE(ohm::isOccupied(ohm::Voxel<const float>(&prior, prior.layout().occupancyLayer(), removed)));
+  for (int i = 0; i < 10; ++i)
+  {
+    ohm::integrateMiss(*live, removed);
+  }
+
+  // A previously unobserved voxel.
+  ohm::integrateHit(*live, live->voxelKey(glm::dvec3(3.05, 3.05, 3.05)));
+
+  ohm::compare::ChangesOptions options;
+  options.since_stamp = since_stamp;
+  result = ohm::compare::detectChanges(*live, prior, options);
+  ASSERT_TRUE(result);
+  EXPECT_LT(result.regions_compared, live->regionCount());
+  ASSERT_EQ(result.changes.size(), 4u);
+  ASSERT_EQ(result.blobs.size(), 2u);
+  for (const ohm::compare::ChangeBlob &blob : result.blobs)
+  {
+    if (blob.keys.size() == 3u)
+    {
+      EXPECT_EQ(blob.appeared, 3u);
+      EXPECT_EQ(blob.vanished, 0u);
+      EXPECT_NEAR(blob.centroid.x, 0.55, 1e-6);
+      EXPECT_NEAR(blob.min_extents.x, 0.45, 1e-6);
+      EXPECT_NEAR(blob.max_extents.x, 0.65, 1e-6);
+    }
+    else
+    {
+      ASSERT_EQ(blob.keys.size(), 1u);
+      EXPECT_EQ(blob.keys.front(), removed);
+      EXPECT_EQ(blob.appeared, 0u);
+      EXPECT_EQ(blob.vanished, 1u);
+    }
+  }
+
+  // Include unobserved transitions and compare in parallel.
+  options.include_unobserved = true;
+  options.flags = ohm::compare::kParallel;
+  result = ohm::compare::detectChanges(*live, prior, options);
+  EXPECT_EQ(result.changes.size(), 5u);
+  EXPECT_EQ(result.blobs.size(), 3u);
+
+  // Blob size filtering.
+  options.min_blob_size = 2;
+  result = ohm::compare::detectChanges(*live, prior, options);
+  EXPECT_EQ(result.changes.size(), 5u);
+  EXPECT_EQ(result.blobs.size(), 1u);
+
+  // Nothing changed since the last stamp.
+  options.since_stamp = live->stamp();
+  result = ohm::compare::detectChanges(*live, prior, options);
+  EXPECT_EQ(result.regions_compared, 0u);
+  EXPECT_TRUE(result.changes.empty());
+
+  // Incompatible maps.
+  ohm::OccupancyMap other(0.2, glm::u8vec3(16));
+  EXPECT_FALSE(ohm::compare::detectChanges(*live, other));
+}
+}  // namespace changedetectiontests
@@ -0,0 +1,213 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RoiRangeFillCpu.h>
+#include <ohm/VoxelClearanceChannels.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmutil/GlmStream.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace clearance
+{
+/// Build a map with free space and scattered obstacles spanning several regions.
+void buildMap(ohm::OccupancyMap &map, std::vector<ohm::Key> &obstacles)
+{
+  ohmtestutil::buildObstacleMap(map, obstacles, 0.02);  // NOLINT(readability-magic-numbers)
+
+  ohm::MapLayout layout = map.layout();
+  ohm::addClearance(layout);
+  map.updateLayout(layout);
+}
+
+
+/// Validate the clearance values in @p region_key against a brute force search of the @p obstacles .
+void validateClearance(const ohm::OccupancyMap &map, const glm::i16vec3 &region_key,
+                       const std::vector<ohm::Key> &obstacles, const ohm::RoiRangeFillCpu &query, float tolerance)
+{
+  ohm::Voxel<const float> clearance(&map, map.layout().clearanceLayer());
+  ASSERT_TRUE(clearance.isLayerValid());
+
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  for (int z = 0; z < dim.z; ++z)
+  {
+    for (int y = 0; y < dim.y; ++y)
+    {
+      for (int x = 0; x < dim.x; ++x)
+      {
+        const ohm::Key key(region_key, x, y, z);
+        float expected = std::numeric_limits<float>::max();
+        for (const ohm::Key &obstacle : obstacles)
+        {
+          const glm::vec3 separation =
+            glm::vec3(map.voxelCentreGlobal(obstacle) - map.voxelCentreGlobal(key)) * query.axisScaling();
+          expected = std::min(expected, glm::length(separation));
+        }
+
+        clearance.setKey(key);
+        ASSERT_TRUE(clearance.isValid());
+        const float range = clearance.data();
+        if (expected > query.searchRadius() + 1e-4f)
+        {
+          EXPECT_LT(range, 0.0f) << region_key << " " << key.localKey();
+        }
+        else if (expected + tolerance <= query.searchRadius())
+        {
+          EXPECT_GE(range, expected - 1e-4f) << region_key << " " << key.localKey();
+          EXPECT_LE(range, expected + tolerance) << region_key << " " << key.localKey();
+        }
+        else if (range >= 0)
+        {
+          // Near the search radius the approximation may push results out of range.
+          EXPECT_GE(range, expected - 1e-4f) << region_key << " " << key.localKey();
+        }
+      }
+    }
+  }
+}
+
+
+TEST(Clearance, RoiRangeFillCpu)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(8));
+  std::vector<ohm::Key> obstacles;
+  buildMap(map, obstacles);
+  ASSERT_FALSE(obstacles.empty());
+
+  ohm::RoiRangeFillCpu query;
+  query.setSearchRadius(0.6f);  // NOLINT(readability-magic-numbers)
+  query.setQueryFlags(0);
+
+  const std::vector<glm::i16vec3> region_keys = { glm::i16vec3(0), glm::i16vec3(-1), glm::i16vec3(-1, 0, 1) };
+  for (const auto &region_key : region_keys)
+  {
+    ASSERT_TRUE(query.calculateForRegion(map, region_key));
+    validateClearance(map, region_key, obstacles, query, float(resolution));
+  }
+
+  // Threaded and single threaded results must match exactly.
+  ohm::Voxel<const float> clearance(&map, map.layout().clearanceLayer());
+  std::vector<float> threaded_results;
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  for (int i = 0; i < dim.x * dim.y * dim.z; ++i)
+  {
+    clearance.setKey(ohm::Key(region_keys.front(), ohm::voxelLocalKey(unsigned(i), dim)));
+    threaded_results.emplace_back(clearance.data());
+  }
+  clearance.reset();
+
+  query.setUseThreads(false);
+  ASSERT_TRUE(query.calculateForRegion(map, region_keys.front()));
+  clearance = ohm::Voxel<const float>(&map, map.layout().clearanceLayer());
+  for (int i = 0; i < dim.x * dim.y * dim.z; ++i)
+  {
+    clearance.setKey(ohm::Key(region_keys.front(), ohm::voxelLocalKey(unsigned(i), dim)));
+    EXPECT_EQ(clearance.data(), threaded_results[i]);
+  }
+  clearance.reset();
+
+  // Validate with axis scaling.
+  query.setAxisScaling(glm::vec3(1, 1, 2));
+  ASSERT_TRUE(query.calculateForRegion(map, region_keys.front()));
+  validateClearance(map, region_keys.front(), obstacles, query, 2.0f * float(resolution));
+
+  // Missing regions fail.
+  EXPECT_FALSE(query.calculateForRegion(map, glm::i16vec3(100)));
+}
+
+
+TEST(Clearance, ChannelsCpu)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(8));
+  std::vector<ohm::Key> obstacles;
+  buildMap(map, obstacles);
+  ASSERT_FALSE(obstacles.empty());
+
+  ohm::MapLayout layout = map.layout();
+  ohm::addClearanceChannels(layout);
+  map.updateLayout(layout);
+
+  ohm::RoiRangeFillCpu query;
+  query.setSearchRadius(0.6f);  // NOLINT(readability-magic-numbers)
+  query.setQueryFlags(0);
+  query.setCalculateChannels(true);
+
+  const glm::i16vec3 region_key(-1, 0, -1);
+  ASSERT_TRUE(query.calculateForRegion(map, region_key));
+  validateClearance(map, region_key, obstacles, query, float(resolution));
+
+  ohm::Voxel<const ohm::VoxelClearanceChannels> channels(
+    &map, map.layout().layerIndex(ohm::default_layer::clearanceChannelsLayerName()));
+  ASSERT_TRUE(channels.isLayerValid());
+
+  const float epsilon = 1e-4f;
+  const glm::ivec3 dim = map.regionVoxelDimensions();
+  for (int z = 0; z < dim.z; ++z)
+  {
+    for (int y = 0; y < dim.y; ++y)
+    {
+      for (int x = 0; x < dim.x; ++x)
+      {
+        const ohm::Key key(region_key, x, y, z);
+        float expected_horizontal = std::numeric_limits<float>::max();
+        float expected_overhead = std::numeric_limits<float>::max();
+        for (const ohm::Key &obstacle : obstacles)
+        {
+          const glm::vec3 separation = glm::vec3(map.voxelCentreGlobal(obstacle) - map.voxelCentreGlobal(key));
+          if (std::abs(separation.z) < epsilon)
+          {
+            expected_horizontal = std::min(expected_horizontal, glm::length(separation));
+          }
+          if (std::abs(separation.x) < epsilon && std::abs(separation.y) < epsilon && separation.z > -epsilon)
+          {
+            expected_overhead = std::min(expected_overhead, separation.z);
+          }
+        }
+
+        channels.setKey(key);
+        ASSERT_TRUE(channels.isValid());
+        const ohm::VoxelClearanceChannels value = channels.data();
+
+        // The overhead channel is exact.
+        if (expected_overhead > query.searchRadius() + epsilon)
+        {
+          EXPECT_LT(value.overhead, 0.0f) << key.localKey();
+        }
+        else
+        {
+          EXPECT_NEAR(value.overhead, expected_overhead, epsilon) << key.localKey();
+        }
+
+        // The horizontal channel is propagated, so may be optimistic.
+        if (expected_horizontal > query.searchRadius() + epsilon)
+        {
+          EXPECT_LT(value.horizontal, 0.0f) << key.localKey();
+        }
+        else if (expected_horizontal + resolution <= query.searchRadius())
+        {
+          EXPECT_GE(value.horizontal, expected_horizontal - epsilon) << key.localKey();
+          EXPECT_LE(value.horizontal, expected_horizontal + resolution) << key.localKey();
+        }
+      }
+    }
+  }
+}
+}  // namespace clearance
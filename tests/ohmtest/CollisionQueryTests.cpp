@@ -0,0 +1,277 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/CollisionQuery.h>
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace collisionquerytests
+{
+/// Brute force check for whether @p point lies inside @p shape at @p pose , inflated by @p padding .
+bool containsPoint(const ohm::CollisionShape &shape, const ohm::CollisionPose &pose, double padding,
+                   const glm::dvec3 &point)
+{
+  const glm::dquat rotation = pose.rotation * shape.rotation;
+  const glm::dvec3 centre = pose.position + pose.rotation * shape.offset;
+  const glm::dvec3 local = glm::inverse(rotation) * (point - centre);
+  if (shape.type == ohm::CollisionShape::kBox)
+  {
+    return glm::all(glm::lessThanEqual(glm::abs(local), shape.half_extents + glm::dvec3(padding)));
+  }
+
+  const glm::dvec3 closest(0, 0, glm::clamp(local.z, -shape.half_length, shape.half_length));
+  return glm::length(local - closest) <= shape.radius + padding;
+}
+
+
+TEST(CollisionQuery, Shapes)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(8));
+
+  // Observe free space around a single obstacle.
+  const glm::dvec3 obstacle_pos(0.55, 0.05, 0.05);  // NOLINT(readability-magic-numbers)
+  const ohm::Key obstacle = map.voxelKey(obstacle_pos);
+  for (int z = -10; z < 10; ++z)  // NOLINT(readability-magic-numbers)
+  {
+    for (int y = -10; y < 10; ++y)  // NOLINT(readability-magic-numbers)
+    {
+      for (int x = -10; x < 15; ++x)  // NOLINT(readability-magic-numbers)
+      {
+        const ohm::Key key = map.voxelKey(glm::dvec3(x + 0.5, y + 0.5, z + 0.5) * resolution);
+        if (key != obstacle)
+        {
+          ohm::integrateMiss(map, key);
+        }
+      }
+    }
+  }
+  ohm::integrateHit(map, obstacle);
+
+  // A long thin box along x.
+  const ohm::CollisionShape box = ohm::CollisionShape::box(glm::dvec3(0.4, 0.08, 0.08));  // NOLINT
+  // Rotate about z by 90 degrees to lie along y.
+  const glm::dquat yaw90 = glm::angleAxis(0.5 * M_PI, glm::dvec3(0, 0, 1));
+
+  std::vector<ohm::CollisionPose> poses;
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0), glm::dquat(1, 0, 0, 0) });           // Free.
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.3, 0, 0), glm::dquat(1, 0, 0, 0) });   // Reaches the obstacle.
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.55, 0.4, 0), glm::dquat(1, 0, 0, 0) });  // Beside it.
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.55, 0.4, 0), yaw90 });                 // Rotated into it.
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(-5, 0, 0), glm::dquat(1, 0, 0, 0) });    // Unobserved space.
+
+  ohm::CollisionQuery query(map, 0);
+  query.setShapes(&box, 1);
+  query.setPoses(poses.data(), poses.size());
+  ASSERT_TRUE(query.execute());
+  ASSERT_EQ(query.numberOfResults(), poses.size());
+  EXPECT_FALSE(query.collides(0));
+  EXPECT_TRUE(query.collides(1));
+  EXPECT_EQ(query.intersectedVoxels()[1], obstacle);
+  EXPECT_FALSE(query.collides(2));
+  EXPECT_TRUE(query.collides(3));
+  EXPECT_EQ(query.intersectedVoxels()[3], obstacle);
+  EXPECT_FALSE(query.collides(4));
+
+  // Unobserved space is an obstruction with kQfUnknownAsOccupied.
+  query.setQueryFlags(ohm::kQfUnknownAsOccupied);
+  ASSERT_TRUE(query.execute());
+  EXPECT_TRUE(query.collides(4));
+
+  // A capsule along the rotated z axis.
+  const glm::dquat pitch90 = glm::angleAxis(0.5 * M_PI, glm::dvec3(0, 1, 0));
+  const ohm::CollisionShape capsule = ohm::CollisionShape::capsule(0.05, 0.3, glm::dvec3(0), pitch90);  // NOLINT
+  query.setQueryFlags(0);
+  query.setShapes(&capsule, 1);
+  poses.clear();
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.55, 0.05, 0.3), glm::dquat(1, 0, 0, 0) });  // Above.
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.3, 0.05, 0.05), glm::dquat(1, 0, 0, 0) });  // End cap reaches.
+  query.setPoses(poses.data(), poses.size());
+  ASSERT_TRUE(query.execute());
+  EXPECT_FALSE(query.collides(0));
+  EXPECT_TRUE(query.collides(1));
+
+  // Sweep a small box through the obstacle. Neither end pose collides.
+  const ohm::CollisionShape small_box = ohm::CollisionShape::box(glm::dvec3(0.1));  // NOLINT
+  query.setShapes(&small_box, 1);
+  query.setQueryFlags(ohm::CollisionQuery::kQfSweep);
+  poses.clear();
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.0, 0.05, 0.05), glm::dquat(1, 0, 0, 0) });
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(1.1, 0.05, 0.05), glm::dquat(1, 0, 0, 0) });
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(0.0, 0.5, 0.05), glm::dquat(1, 0, 0, 0) });
+  poses.emplace_back(ohm::CollisionPose{ glm::dvec3(1.1, 0.5, 0.05), glm::dquat(1, 0, 0, 0) });
+  query.setPoses(poses.data(), poses.size());
+  ASSERT_TRUE(query.execute());
+  ASSERT_EQ(query.numberOfResults(), 2u);
+  EXPECT_TRUE(query.collides(0));
+  EXPECT_FALSE(query.collides(1));
+}
+
+
+TEST(CollisionQuery, BruteForce)
+{
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(8));
+  std::vector<ohm::Key> obstacles;
+  ohmtestutil::buildObstacleMap(map, obstacles, 0.002);  // NOLINT(readability-magic-numbers)
+  ASSERT_FALSE(obstacles.empty());
+
+  // A robot made of a body box and an arm capsule.
+  const std::vector<ohm::CollisionShape> shapes = {
+    ohm::CollisionShape::box(glm::dvec3(0.15, 0.1, 0.05)),  // NOLINT(readability-magic-numbers)
+    ohm::CollisionShape::capsule(0.04, 0.1, glm::dvec3(0.2, 0, 0.05),  // NOLINT(readability-magic-numbers)
+                                 glm::angleAxis(0.3, glm::normalize(glm::dvec3(1, 1, 0))))
+  };
+  const double padding = 0.01;
+
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand_pos(-0.8, 0.8);
+  std::uniform_real_distribution<double> rand_angle(-M_PI, M_PI);
+  std::vector<ohm::CollisionPose> poses;
+  for (unsigned i = 0; i < 500; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    ohm::CollisionPose pose;
+    pose.position = glm::dvec3(rand_pos(rand_engine), rand_pos(rand_engine), rand_pos(rand_engine));
+    pose.rotation = glm::angleAxis(rand_angle(rand_engine), glm::normalize(glm::dvec3(0.2, -0.3, 1.0)));
+    poses.emplace_back(pose);
+  }
+
+  std::vector<bool> expected;
+  for (const auto &pose : poses)
+  {
+    bool collides = false;
+    for (const auto &shape : shapes)
+    {
+      for (const auto &obstacle : obstacles)
+      {
+        collides = collides || containsPoint(shape, pose, padding, map.voxelCentreGlobal(obstacle));
+      }
+    }
+    expected.emplace_back(collides);
+  }
+  // Make sure the test is meaningful.
+  ASSERT_NE(std::count(expected.begin(), expected.end(), true), 0);
+  ASSERT_NE(std::count(expected.begin(), expected.end(), false), 0);
+
+  for (bool use_threads : { false, true })
+  {
+    ohm::CollisionQuery query(map, 0);
+    query.setUseThreads(use_threads);
+    query.setPadding(padding);
+    query.setShapes(shapes.data(), shapes.size());
+    query.setPoses(poses.data(), poses.size());
+    ASSERT_TRUE(query.executeAsync());
+    ASSERT_TRUE(query.wait());
+    ASSERT_EQ(query.numberOfResults(), poses.size());
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+      EXPECT_EQ(query.collides(i), expected[i]) << i;
+      if (query.collides(i))
+      {
+        EXPECT_NE(std::find(obstacles.begin(), obstacles.end(), query.intersectedVoxels()[i]), obstacles.end());
+      }
+    }
+  }
+}
+
+
+TEST(CollisionQuery, Clearance)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(8));
+  std::vector<ohm::Key> obstacles;
+  ohmtestutil::buildObstacleMap(map, obstacles, 0.005);  // NOLINT(readability-magic-numbers)
+  ASSERT_FALSE(obstacles.empty());
+
+  ohm::MapLayout layout = map.layout();
+  ohm::addClearance(layout);
+  map.updateLayout(layout);
+
+  // Write exact clearance values for the observed regions, limited to a search radius.
+  const float search_radius = 0.5f;  // NOLINT(readability-magic-numbers)
+  {
+    ohm::Voxel<float> clearance(&map, map.layout().clearanceLayer());
+    const glm::ivec3 dim = map.regionVoxelDimensions();
+    for (int rz = -2; rz < 2; ++rz)
+    {
+      for (int ry = -2; ry < 2; ++ry)
+      {
+        for (int rx = -2; rx < 2; ++rx)
+        {
+          for (int i = 0; i < dim.x * dim.y * dim.z; ++i)
+          {
+            const ohm::Key key(glm::i16vec3(rx, ry, rz), ohm::voxelLocalKey(unsigned(i), dim));
+            float range = std::numeric_limits<float>::max();
+            for (const auto &obstacle : obstacles)
+            {
+              range = std::min(range, float(glm::length(map.voxelCentreGlobal(obstacle) - map.voxelCentreGlobal(key))));
+            }
+            clearance.setKey(key);
+            if (clearance.isValid())
+            {
+              clearance.write((range <= search_radius) ? range : -1.0f);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand_pos(-0.8, 0.8);
+  std::uniform_real_distribution<double> rand_angle(-M_PI, M_PI);
+  std::vector<ohm::CollisionPose> poses;
+  for (unsigned i = 0; i < 300; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    ohm::CollisionPose pose;
+    pose.position = glm::dvec3(rand_pos(rand_engine), rand_pos(rand_engine), rand_pos(rand_engine));
+    pose.rotation = glm::angleAxis(rand_angle(rand_engine), glm::normalize(glm::dvec3(1.0, 0.5, 0.2)));
+    poses.emplace_back(pose);
+  }
+
+  const ohm::CollisionShape capsule = ohm::CollisionShape::capsule(0.1, 0.2);  // NOLINT
+  ohm::CollisionQuery occupancy_query(map, 0);
+  occupancy_query.setShapes(&capsule, 1);
+  occupancy_query.setPoses(poses.data(), poses.size());
+  ASSERT_TRUE(occupancy_query.execute());
+
+  ohm::CollisionQuery clearance_query(map, ohm::CollisionQuery::kQfUseClearance);
+  clearance_query.setShapes(&capsule, 1);
+  clearance_query.setPoses(poses.data(), poses.size());
+  ASSERT_TRUE(clearance_query.execute());
+
+  // The clearance test is conservative: every occupancy collision must also be a clearance collision.
+  size_t occupancy_collisions = 0;
+  size_t clearance_collisions = 0;
+  for (size_t i = 0; i < poses.size(); ++i)
+  {
+    if (occupancy_query.collides(i))
+    {
+      EXPECT_TRUE(clearance_query.collides(i)) << i;
+      ++occupancy_collisions;
+    }
+    clearance_collisions += clearance_query.collides(i);
+  }
+  EXPECT_GT(occupancy_collisions, 0u);
+  EXPECT_LT(clearance_collisions, poses.size());
+}
+}  // namespace collisionquerytests
@@ -0,0 +1,149 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/CompactRays.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/RaysQuery.h>
+
+#include <ohmtestcommon/OhmTestUtil.h>
+
+#include <gtest/gtest.h>
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace compactraystests
+{
+/// Generate rays from a far from zero sensor position, out to @p max_range .
+std::vector<glm::dvec3> makeRays(const glm::dvec3 &sensor, double max_range, size_t ray_count)
+{
+  std::mt19937 rand_engine(0x5eed);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-max_range, max_range);
+  std::vector<glm::dvec3> rays;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(sensor);
+    rays.emplace_back(sensor + glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+  return rays;
+}
+
+
+TEST(CompactRays, Conversion)
+{
+  const glm::dvec3 sensor(1000.25, -2000.5, 30.125);  // NOLINT(readability-magic-numbers)
+  const double max_range = 50.0;
+  const std::vector<glm::dvec3> rays = makeRays(sensor, max_range, 1000);
+
+  // Single precision conversion relative to the sensor is accurate to a few microns.
+  std::vector<glm::vec3> relative_rays;
+  double max_error = 0;
+  ASSERT_TRUE(ohm::relativeRays(rays.data(), rays.size(), sensor, relative_rays, 1e-5, &max_error));
+  ASSERT_EQ(relative_rays.size(), rays.size());
+  EXPECT_GT(max_error, 0.0);
+  EXPECT_LE(max_error, 1e-5);
+  // A tighter tolerance fails validation.
+  EXPECT_FALSE(ohm::relativeRays(rays.data(), rays.size(), sensor, relative_rays, 1e-9));
+
+  std::vector<glm::dvec3> expanded(rays.size());
+  ohm::expandRays(relative_rays.data(), relative_rays.size(), sensor, expanded.data());
+  for (size_t i = 0; i < rays.size(); ++i)
+  {
+    ASSERT_NEAR(glm::length(expanded[i] - rays[i]), 0.0, 1e-5) << i;
+  }
+
+  // Quantise with just enough range.
+  const double quantisation = ohm::quantisationForRange(max_range);
+  std::vector<glm::i16vec3> quantised_rays;
+  ASSERT_TRUE(ohm::quantiseRays(rays.data(), rays.size(), sensor, quantisation, quantised_rays, &max_error));
+  ASSERT_EQ(quantised_rays.size(), rays.size());
+  EXPECT_LE(max_error, 0.5 * quantisation + 1e-9);
+
+  ohm::expandRays(quantised_rays.data(), quantised_rays.size(), sensor, quantisation, expanded.data());
+  for (size_t i = 0; i < rays.size(); ++i)
+  {
+    ASSERT_LE(glm::length(expanded[i] - rays[i]), quantisation) << i;
+  }
+
+  // Out of range and invalid values fail validation.
+  EXPECT_FALSE(ohm::quantiseRays(rays.data(), rays.size(), sensor, 0.5 * quantisation, quantised_rays));
+  EXPECT_FALSE(ohm::quantiseRays(rays.data(), rays.size(), sensor, 0.0, quantised_rays));
+  std::vector<glm::dvec3> bad_rays = rays;
+  bad_rays[3].y = std::numeric_limits<double>::quiet_NaN();
+  EXPECT_FALSE(ohm::quantiseRays(bad_rays.data(), bad_rays.size(), sensor, quantisation, quantised_rays));
+  EXPECT_FALSE(ohm::relativeRays(bad_rays.data(), bad_rays.size(), sensor, relative_rays));
+}
+
+
+TEST(CompactRays, Integrate)
+{
+  // Compact rays must integrate the same as their expanded equivalent.
+  const glm::dvec3 sensor(100.25, -20.5, 3.125);  // NOLINT(readability-magic-numbers)
+  const double max_range = 5.0;
+  const double resolution = 0.1;
+  std::vector<glm::dvec3> rays = makeRays(sensor, max_range, 2000);
+  std::vector<float> intensities(rays.size() / 2, 1.0f);
+  std::vector<double> timestamps(rays.size() / 2);
+  for (size_t i = 0; i < timestamps.size(); ++i)
+  {
+    timestamps[i] = 0.001 * double(i);  // NOLINT(readability-magic-numbers)
+  }
+
+  std::vector<glm::vec3> relative_rays;
+  ASSERT_TRUE(ohm::relativeRays(rays.data(), rays.size(), sensor, relative_rays, 0.01 * resolution));
+  const double quantisation = 0.01 * resolution;
+  std::vector<glm::i16vec3> quantised_rays;
+  ASSERT_TRUE(ohm::quantiseRays(rays.data(), rays.size(), sensor, quantisation, quantised_rays));
+
+  std::vector<glm::dvec3> expanded(rays.size());
+  {
+    ohm::expandRays(relative_rays.data(), relative_rays.size(), sensor, expanded.data());
+    ohm::OccupancyMap reference_map(resolution);
+    ohm::RayMapperOccupancy reference_mapper(&reference_map);
+    reference_mapper.integrateRays(expanded.data(), expanded.size(), intensities.data(), timestamps.data(),
+                                   ohm::kRfDefault);
+
+    ohm::OccupancyMap map(resolution);
+    ohm::RayMapperOccupancy mapper(&map);
+    EXPECT_EQ(mapper.integrateRelativeRays(relative_rays.data(), relative_rays.size(), sensor, intensities.data(),
+                                           timestamps.data(), ohm::kRfDefault),
+              rays.size() / 2);
+    ohmtestutil::compareMaps(map, reference_map, ohmtestutil::kCfCompareExtended);
+  }
+
+  {
+    ohm::expandRays(quantised_rays.data(), quantised_rays.size(), sensor, quantisation, expanded.data());
+    ohm::OccupancyMap reference_map(resolution);
+    ohm::RayMapperOccupancy reference_mapper(&reference_map);
+    reference_mapper.integrateRays(expanded.data(), expanded.size(), intensities.data(), timestamps.data(),
+                                   ohm::kRfDefault);
+
+    ohm::OccupancyMap map(resolution);
+    ohm::RayMapperOccupancy mapper(&map);
+    EXPECT_EQ(mapper.integrateQuantisedRays(quantised_rays.data(), quantised_rays.size(), sensor, quantisation,
+                                            intensities.data(), timestamps.data(), ohm::kRfDefault),
+              rays.size() / 2);
+    ohmtestutil::compareMaps(map, reference_map, ohmtestutil::kCfCompareExtended);
+
+    // The query accepts the same compact rays.
+    ohm::RaysQuery query;
+    query.addRays(quantised_rays.data(), quantised_rays.size(), sensor, quantisation);
+    ASSERT_EQ(query.numberOfRays(), rays.size() / 2);
+    size_t ray_element_count = 0;
+    const glm::dvec3 *query_rays = query.rays(&ray_element_count);
+    ASSERT_EQ(ray_element_count, expanded.size());
+    for (size_t i = 0; i < expanded.size(); ++i)
+    {
+      ASSERT_EQ(query_rays[i], expanded[i]);
+    }
+  }
+}
+}  // namespace compactraystests
@@ -9,20 +9,111 @@
 
 #include <ohm/DefaultLayer.h>
 #include <ohm/MapLayer.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
+#include <ohm/NdtMap.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperNdt.h>
 #include <ohm/VoxelBlock.h>
 #include <ohm/VoxelBlockCompressionQueue.h>
+#include <ohm/VoxelBuffer.h>
+#include <ohm/VoxelOccupancy.h>
 
 #include <logutil/LogUtil.h>
 
+#include <glm/vec3.hpp>
+
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
 
 namespace
 {
 using Clock = std::chrono::high_resolution_clock;
+
+/// Restores the default compression controls on scope exit.
+class CompressionControlsScope
+{
+public:
+  CompressionControlsScope() { ohm::VoxelBlock::getCompressionControls(&controls_); }
+  ~CompressionControlsScope() { ohm::VoxelBlock::setCompressionControls(controls_); }
+
+  CompressionControlsScope(const CompressionControlsScope &) = delete;
+  CompressionControlsScope &operator=(const CompressionControlsScope &) = delete;
+
+private:
+  ohm::VoxelBlock::CompressionControls controls_;
+};
+
+/// Populate an NDT map with random rays to generate non-trivial occupancy, mean and covariance data.
+void populateNdtMap(ohm::OccupancyMap &map, size_t ray_count, unsigned seed)
+{
+  ohm::NdtMap ndt(&map, true);
+  ohm::RayMapperNdt mapper(&ndt);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> rand(-4.0, 4.0);
+  std::vector<glm::dvec3> rays;
+  rays.reserve(2 * ray_count);
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(rand(rng), rand(rng), 0.25 * rand(rng)));
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+}
+
+/// Collect the @c VoxelBlock objects for @p layer_index from @p map .
+std::vector<ohm::VoxelBlock *> collectBlocks(ohm::OccupancyMap &map, int layer_index)
+{
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  std::vector<ohm::VoxelBlock *> blocks;
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    blocks.emplace_back(chunk->voxel_blocks[layer_index].get());
+  }
+  return blocks;
 }
 
+/// Compress and decompress each of the blocks in @p blocks with the current compression controls, validating the
+/// content is restored. The controls are changed to @p decompress_type before decompressing to validate the block
+/// remembers how it was compressed.
+void testRoundTrip(const std::vector<ohm::VoxelBlock *> &blocks, ohm::VoxelBlock::CompressionType decompress_type)
+{
+  std::vector<std::vector<uint8_t>> reference(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    blocks[i]->retain();
+    reference[i].assign(blocks[i]->voxelBytes(), blocks[i]->voxelBytes() + blocks[i]->uncompressedByteSize());
+    blocks[i]->release();
+  }
+
+  std::vector<uint8_t> compression_buffer;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    EXPECT_GT(blocks[i]->compressWithTemporaryBuffer(compression_buffer), 0u);
+    EXPECT_FALSE((blocks[i]->flags() & ohm::VoxelBlock::kFUncompressed));
+  }
+
+  ohm::VoxelBlock::CompressionControls controls;
+  controls.compression_type = decompress_type;
+  ohm::VoxelBlock::setCompressionControls(controls);
+
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    blocks[i]->retain();
+    ASSERT_TRUE((blocks[i]->flags() & ohm::VoxelBlock::kFUncompressed));
+    EXPECT_EQ(memcmp(blocks[i]->voxelBytes(), reference[i].data(), reference[i].size()), 0);
+    blocks[i]->release();
+  }
+}
+}  // namespace
+
 TEST(Compression, Simple)
 {
   ohm::VoxelBlockCompressionQueue compressor(true);  // Instantiate in test mode
@@ -181,3 +272,483 @@ TEST(Compression, HighLoad)
   EXPECT_EQ(compressor.estimatedAllocationSize(), 0);
   std::cout << "Release tick: " << (end - start) << std::endl;
 }
+
+
+TEST(Compression, Codecs)
+{
+  CompressionControlsScope restore_controls;
+  // Create a map in order to use the layout. DO NOT SET kCompressed. We manage compression explicitly.
+  ohm::OccupancyMap map(0.1, ohm::MapFlag::kNone);
+  populateNdtMap(map, 500, 1234u);
+
+  const int layers[] = { map.layout().occupancyLayer(), map.layout().meanLayer(), map.layout().covarianceLayer() };
+  const ohm::VoxelBlock::CompressionType types[] = { ohm::VoxelBlock::kCompressDeflate, ohm::VoxelBlock::kCompressGZip,
+                                                     ohm::VoxelBlock::kCompressLz4, ohm::VoxelBlock::kCompressZstd };
+  const ohm::VoxelBlock::CompressionLevel levels[] = { ohm::VoxelBlock::kCompressFast,
+                                                       ohm::VoxelBlock::kCompressBalanced };
+
+  for (ohm::VoxelBlock::CompressionType type : types)
+  {
+    ohm::VoxelBlock::CompressionControls controls;
+    controls.compression_type = type;
+    ohm::VoxelBlock::setCompressionControls(controls);
+    ohm::VoxelBlock::getCompressionControls(&controls);
+    if (!ohm::VoxelBlock::compressionTypeSupported(type))
+    {
+      // Expect fallback.
+      EXPECT_EQ(controls.compression_type, ohm::VoxelBlock::kCompressDeflate);
+      continue;
+    }
+    EXPECT_EQ(controls.compression_type, type);
+
+    for (ohm::VoxelBlock::CompressionLevel level : levels)
+    {
+      for (int layer_index : layers)
+      {
+        ASSERT_NE(layer_index, -1);
+        controls.compression_type = type;
+        controls.compression_level = level;
+        ohm::VoxelBlock::setCompressionControls(controls);
+        // Decompress with a different type selected.
+        testRoundTrip(collectBlocks(map, layer_index), (type == ohm::VoxelBlock::kCompressGZip) ?
+                                                         ohm::VoxelBlock::kCompressDeflate :
+                                                         ohm::VoxelBlock::kCompressGZip);
+      }
+    }
+  }
+}
+
+
+TEST(Compression, ZstdDictionary)
+{
+  if (!ohm::VoxelBlock::compressionTypeSupported(ohm::VoxelBlock::kCompressZstd))
+  {
+    GTEST_SKIP() << "Zstd compression not supported";
+  }
+
+  CompressionControlsScope restore_controls;
+  ohm::OccupancyMap map(0.1, ohm::MapFlag::kNone);
+  populateNdtMap(map, 500, 4321u);
+
+  const std::vector<ohm::VoxelBlock *> blocks = collectBlocks(map, map.layout().covarianceLayer());
+  ASSERT_FALSE(blocks.empty());
+
+  auto dictionary = std::make_shared<std::vector<uint8_t>>();
+  ASSERT_TRUE(ohm::VoxelBlock::trainCompressionDictionary(blocks, 8 * 1024u, *dictionary));
+  EXPECT_FALSE(dictionary->empty());
+
+  ohm::VoxelBlock::CompressionControls controls;
+  controls.compression_type = ohm::VoxelBlock::kCompressZstd;
+  controls.dictionary = dictionary;
+  ohm::VoxelBlock::setCompressionControls(controls);
+  ohm::VoxelBlock::getCompressionControls(&controls);
+  EXPECT_EQ(controls.dictionary, dictionary);
+
+  // Decompress after replacing the controls with no dictionary. The blocks must retain the dictionary.
+  testRoundTrip(blocks, ohm::VoxelBlock::kCompressZstd);
+}
+
+
+TEST(Compression, Workers)
+{
+  ohm::VoxelBlockCompressionQueue compressor(true);  // Instantiate in test mode
+  EXPECT_EQ(compressor.workerCount(), 1u);
+  compressor.setWorkerCount(4);
+  EXPECT_EQ(compressor.workerCount(), 4u);
+  compressor.setWorkerCount(0);
+  EXPECT_EQ(compressor.workerCount(), ohm::VoxelBlockCompressionQueue::defaultWorkerCount());
+  compressor.setWorkerCount(4);
+
+  // Create a map in order to use the layout. DO NOT SET kCompressed. That would start a new compression object.
+  ohm::OccupancyMap map(1.0, ohm::MapFlag::kNone);
+  std::vector<ohm::VoxelBlock::Ptr> blocks;
+  std::vector<uint8_t> compression_buffer;
+
+  const size_t block_count = 200;
+  const ohm::MapLayer &layer = map.layout().layer(map.layout().occupancyLayer());
+  const size_t layer_mem_size = layer.layerByteSize(map.regionVoxelDimensions());
+  const size_t uncompressed_size = layer_mem_size * block_count;
+  for (size_t i = 0; i < block_count; ++i)
+  {
+    blocks.emplace_back();
+    blocks[i].reset(new ohm::VoxelBlock(map.detail(), layer));
+    compressor.push(blocks[i].get());
+  }
+
+  // No pressure below the high tide.
+  compressor.setHighTide(uncompressed_size + 1);
+  compressor.setLowTide(uncompressed_size / 2);
+  compressor.__tick(compression_buffer);
+  EXPECT_EQ(compressor.estimatedAllocationSize(), uncompressed_size);
+  EXPECT_EQ(compressor.evictionPressure(), 0.0);
+
+  // Half way over the tide range.
+  const uint64_t tide_range = 20 * layer_mem_size;
+  compressor.setHighTide(uncompressed_size - tide_range / 2);
+  compressor.setLowTide(uncompressed_size - tide_range / 2 - tide_range);
+  EXPECT_NEAR(compressor.evictionPressure(), 0.5, 1e-6);
+
+  // Compress everything using the workers.
+  compressor.setHighTide(0);
+  compressor.setLowTide(0);
+  EXPECT_EQ(compressor.evictionPressure(), 1.0);
+  compressor.__tick(compression_buffer);
+  EXPECT_LT(compressor.estimatedAllocationSize(), uncompressed_size);
+  for (auto &block : blocks)
+  {
+    EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUncompressed));
+  }
+
+  // Decompress and recompress down to a low tide. Allow for each worker to overshoot by one block.
+  for (auto &block : blocks)
+  {
+    block->retain();
+    block->release();
+  }
+  compressor.setHighTide(uncompressed_size + 1);
+  compressor.__tick(compression_buffer);
+  EXPECT_EQ(compressor.estimatedAllocationSize(), uncompressed_size);
+
+  compressor.setHighTide(0);
+  compressor.setLowTide(uncompressed_size / 2);
+  compressor.__tick(compression_buffer);
+  size_t uncompressed_count = 0;
+  for (auto &block : blocks)
+  {
+    uncompressed_count += (block->flags() & ohm::VoxelBlock::kFUncompressed) ? 1 : 0;
+  }
+  EXPECT_LT(compressor.estimatedAllocationSize(), uncompressed_size / 2);
+  EXPECT_LE(uncompressed_count, block_count / 2);
+  EXPECT_GE(uncompressed_count + compressor.workerCount(), block_count / 2);
+
+  // Ensure the blocks are releases.
+  blocks.clear();
+  compressor.__tick(compression_buffer);
+  EXPECT_EQ(compressor.estimatedAllocationSize(), 0);
+}
+
+
+TEST(Compression, UniformBlocks)
+{
+  // Create a map in order to use the layout. DO NOT SET kCompressed. That would start a new compression object.
+  ohm::OccupancyMap map(0.25, ohm::MapFlag::kUniformBlocks);
+  const ohm::MapLayer &layer = map.layout().layer(map.layout().occupancyLayer());
+  const size_t layer_mem_size = layer.layerByteSize(map.regionVoxelDimensions());
+  const size_t voxel_count = layer.volume(map.regionVoxelDimensions());
+
+  // A new block is uniform with no memory allocated.
+  ohm::VoxelBlock::Ptr block(new ohm::VoxelBlock(map.detail(), layer));
+  EXPECT_TRUE((block->flags() & ohm::VoxelBlock::kFUniform));
+  EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUncompressed));
+
+  // A uniform, non-default write collapses back to the uniform state on release.
+  const float fill_value = 0.5f;
+  {
+    ohm::VoxelBuffer<ohm::VoxelBlock> buffer(block);
+    ASSERT_EQ(buffer.voxelMemorySize(), layer_mem_size);
+    EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUniform));
+    for (unsigned i = 0; i < voxel_count; ++i)
+    {
+      float value = 0;
+      buffer.readVoxel(i, &value);
+      ASSERT_EQ(value, ohm::unobservedOccupancyValue());
+      buffer.writeVoxel(i, fill_value);
+    }
+  }
+  EXPECT_TRUE((block->flags() & ohm::VoxelBlock::kFUniform));
+  EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUniformCandidate));
+
+  // Validate the fill value is restored, then make a non-uniform write. The block must stay dense.
+  {
+    ohm::VoxelBuffer<ohm::VoxelBlock> buffer(block);
+    for (unsigned i = 0; i < voxel_count; ++i)
+    {
+      float value = 0;
+      buffer.readVoxel(i, &value);
+      ASSERT_EQ(value, fill_value);
+    }
+    buffer.writeVoxel(voxel_count / 2, 1.0f);
+  }
+  EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUniform));
+  EXPECT_TRUE((block->flags() & ohm::VoxelBlock::kFUncompressed));
+  {
+    ohm::VoxelBuffer<const ohm::VoxelBlock> buffer(block);
+    float value = 0;
+    buffer.readVoxel(voxel_count / 2, &value);
+    EXPECT_EQ(value, 1.0f);
+    buffer.readVoxel(0, &value);
+    EXPECT_EQ(value, fill_value);
+  }
+  block.reset();
+
+  // Generate long rays with an NDT map, with and without uniform blocks. Regions which are only traversed leave the
+  // mean and covariance layers uniform.
+  ohm::OccupancyMap dense_map(0.25, ohm::MapFlag::kNone);
+  ohm::OccupancyMap sparse_map(0.25, ohm::MapFlag::kUniformBlocks);
+  std::vector<glm::dvec3> rays;
+  const unsigned ray_count = 200;
+  for (unsigned i = 0; i < ray_count; ++i)
+  {
+    const double angle = 2.0 * M_PI * double(i) / double(ray_count);
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(30.0 * std::cos(angle), 30.0 * std::sin(angle), 0.5));
+  }
+  for (ohm::OccupancyMap *target : { &dense_map, &sparse_map })
+  {
+    ohm::NdtMap ndt(target, true);
+    ohm::RayMapperNdt mapper(&ndt);
+    mapper.integrateRays(rays.data(), rays.size());
+  }
+
+  ASSERT_EQ(dense_map.regionCount(), sparse_map.regionCount());
+  std::vector<const ohm::MapChunk *> dense_chunks;
+  dense_map.enumerateRegions(dense_chunks);
+  for (int layer_index = 0; layer_index < int(sparse_map.layout().layerCount()); ++layer_index)
+  {
+    size_t uniform_count = 0;
+    for (const ohm::MapChunk *dense_chunk : dense_chunks)
+    {
+      const ohm::MapChunk *sparse_chunk = sparse_map.region(dense_chunk->region.coord);
+      ASSERT_NE(sparse_chunk, nullptr);
+      {
+        ohm::VoxelBuffer<const ohm::VoxelBlock> dense_buffer(dense_chunk->voxel_blocks[layer_index]);
+        ohm::VoxelBuffer<const ohm::VoxelBlock> sparse_buffer(sparse_chunk->voxel_blocks[layer_index]);
+        ASSERT_EQ(dense_buffer.voxelMemorySize(), sparse_buffer.voxelMemorySize());
+        EXPECT_EQ(memcmp(dense_buffer.voxelMemory(), sparse_buffer.voxelMemory(), dense_buffer.voxelMemorySize()), 0);
+      }
+      uniform_count += (sparse_chunk->voxel_blocks[layer_index]->flags() & ohm::VoxelBlock::kFUniform) ? 1 : 0;
+      EXPECT_FALSE((dense_chunk->voxel_blocks[layer_index]->flags() & ohm::VoxelBlock::kFUniform));
+    }
+
+    if (layer_index == sparse_map.layout().occupancyLayer())
+    {
+      // All regions are traversed.
+      EXPECT_EQ(uniform_count, 0u);
+    }
+    else if (layer_index == sparse_map.layout().covarianceLayer())
+    {
+      // Only regions containing samples modify the covariance.
+      EXPECT_GT(uniform_count, 0u);
+      EXPECT_LT(uniform_count, dense_chunks.size());
+    }
+  }
+}
+
+
+TEST(Compression, SharedClone)
+{
+  // Cloning a compressed map shares the compressed block data. Each map copies the data on write.
+  // DO NOT SET kCompressed. Blocks are explicitly compressed.
+  ohm::OccupancyMap map(0.25, ohm::MapFlag::kNone);
+  populateNdtMap(map, 2000, 0x5678u);
+  const int occupancy_layer = map.layout().occupancyLayer();
+  std::vector<ohm::VoxelBlock *> blocks = collectBlocks(map, occupancy_layer);
+  ASSERT_FALSE(blocks.empty());
+
+  std::vector<std::vector<uint8_t>> reference(blocks.size());
+  std::vector<uint8_t> compression_buffer;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    blocks[i]->retain();
+    reference[i].assign(blocks[i]->voxelBytes(), blocks[i]->voxelBytes() + blocks[i]->uncompressedByteSize());
+    blocks[i]->release();
+    ASSERT_GT(blocks[i]->compressWithTemporaryBuffer(compression_buffer), 0u);
+  }
+
+  std::unique_ptr<ohm::OccupancyMap> clone(map.clone());
+  ASSERT_EQ(clone->regionCount(), map.regionCount());
+  std::vector<ohm::MapChunk *> clone_chunks(blocks.size());
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    clone_chunks[i] = clone->region(chunks[i]->region.coord);
+    ASSERT_NE(clone_chunks[i], nullptr);
+    const ohm::VoxelBlock &clone_block = *clone_chunks[i]->voxel_blocks[occupancy_layer];
+    EXPECT_FALSE((clone_block.flags() & ohm::VoxelBlock::kFUncompressed));
+    EXPECT_TRUE(clone_block.sharesCompressedBytes(*chunks[i]->voxel_blocks[occupancy_layer]));
+  }
+
+  // Modify the clone. The source blocks must be unaffected and remain shared until modified.
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    ohm::VoxelBuffer<ohm::VoxelBlock> buffer(clone_chunks[i]->voxel_blocks[occupancy_layer]);
+    ASSERT_EQ(memcmp(buffer.voxelMemory(), reference[i].data(), reference[i].size()), 0);
+    buffer.writeVoxel(0, 1.0f);
+    EXPECT_FALSE(clone_chunks[i]->voxel_blocks[occupancy_layer]->sharesCompressedBytes(
+      *chunks[i]->voxel_blocks[occupancy_layer]));
+  }
+
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    ohm::VoxelBlock *block = chunks[i]->voxel_blocks[occupancy_layer].get();
+    EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUncompressed));
+    ohm::VoxelBuffer<const ohm::VoxelBlock> buffer(block);
+    EXPECT_EQ(memcmp(buffer.voxelMemory(), reference[i].data(), reference[i].size()), 0);
+  }
+}
+
+TEST(Compression, ConcurrentRetain)
+{
+  // Hammer retain()/release() from multiple threads while another thread tries to compress the block. The block must
+  // never be compressed while retained and must be compressible once all references are released.
+  ohm::OccupancyMap map(1.0, ohm::MapFlag::kNone);
+  const ohm::MapLayer &layer = map.layout().layer(map.layout().occupancyLayer());
+  ohm::VoxelBlock::Ptr block(new ohm::VoxelBlock(map.detail(), layer));
+
+  block->retain();
+  const size_t byte_count = block->uncompressedByteSize();
+  for (size_t i = 0; i < byte_count; ++i)
+  {
+    block->voxelBytes()[i] = uint8_t(i % 251);  // NOLINT(readability-magic-numbers)
+  }
+  block->release();
+
+  const unsigned thread_count = 4;
+  const unsigned iterations = 20000;
+  std::atomic_bool failed{ false };
+  std::atomic_uint running{ thread_count };
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < thread_count; ++t)
+  {
+    threads.emplace_back([&block, &failed, &running, byte_count, t]() {
+      for (unsigned i = 0; i < iterations; ++i)
+      {
+        block->retain();
+        const size_t check_index = (i * 31u + t) % byte_count;  // NOLINT(readability-magic-numbers)
+        if (!(block->flags() & ohm::VoxelBlock::kFUncompressed) ||
+            block->voxelBytes()[check_index] != uint8_t(check_index % 251))  // NOLINT(readability-magic-numbers)
+        {
+          failed = true;
+        }
+        block->release();
+      }
+      --running;
+    });
+  }
+
+  std::vector<uint8_t> compression_buffer;
+  while (running > 0)
+  {
+    block->compressWithTemporaryBuffer(compression_buffer);
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  EXPECT_FALSE(failed);
+  EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFLocked));
+  EXPECT_GT(block->compressWithTemporaryBuffer(compression_buffer), 0u);
+  EXPECT_FALSE((block->flags() & ohm::VoxelBlock::kFUncompressed));
+}
+
+TEST(Compression, Prefetch)
+{
+  ohm::VoxelBlockCompressionQueue compressor(true);  // Instantiate in test mode
+  // Create a map in order to use the layout. DO NOT SET kCompressed. That would start a new compression object.
+  ohm::OccupancyMap map(1.0, ohm::MapFlag::kNone);
+  const ohm::MapLayer &layer = map.layout().layer(map.layout().occupancyLayer());
+  std::vector<ohm::VoxelBlock::Ptr> blocks;
+  std::vector<std::vector<uint8_t>> reference;
+  std::vector<uint8_t> compression_buffer;
+
+  const size_t block_count = 10;
+  for (size_t i = 0; i < block_count; ++i)
+  {
+    blocks.emplace_back(new ohm::VoxelBlock(map.detail(), layer));
+    ohm::VoxelBlock &block = *blocks.back();
+    block.retain();
+    for (size_t j = 0; j < block.uncompressedByteSize(); ++j)
+    {
+      block.voxelBytes()[j] = uint8_t((i + j) % 251);  // NOLINT(readability-magic-numbers)
+    }
+    reference.emplace_back(block.voxelBytes(), block.voxelBytes() + block.uncompressedByteSize());
+    block.release();
+    compressor.push(&block);
+  }
+
+  // Uncompressed blocks have nothing to prefetch.
+  EXPECT_FALSE(compressor.prefetch(blocks.front().get()));
+
+  // Compress everything.
+  compressor.setHighTide(0);
+  compressor.setLowTide(0);
+  compressor.__tick(compression_buffer);
+  for (auto &block : blocks)
+  {
+    ASSERT_FALSE((block->flags() & ohm::VoxelBlock::kFUncompressed));
+  }
+
+  // Prefetch half the blocks. Duplicate requests are ignored.
+  for (size_t i = 0; i < block_count; i += 2)
+  {
+    EXPECT_TRUE(compressor.prefetch(blocks[i].get()));
+    EXPECT_FALSE(compressor.prefetch(blocks[i].get()));
+    EXPECT_TRUE((blocks[i]->flags() & ohm::VoxelBlock::kFPrefetchPending));
+  }
+
+  // Service the requests without compressing again.
+  compressor.setHighTide(std::numeric_limits<uint64_t>::max());
+  compressor.__tick(compression_buffer);
+  for (size_t i = 0; i < block_count; ++i)
+  {
+    const unsigned flags = blocks[i]->flags();
+    EXPECT_FALSE((flags & ohm::VoxelBlock::kFPrefetchPending));
+    EXPECT_FALSE((flags & ohm::VoxelBlock::kFLocked));
+    EXPECT_EQ(bool(flags & ohm::VoxelBlock::kFUncompressed), i % 2 == 0);
+    ohm::VoxelBuffer<const ohm::VoxelBlock> buffer(blocks[i].get());
+    EXPECT_EQ(memcmp(buffer.voxelMemory(), reference[i].data(), reference[i].size()), 0);
+  }
+
+  // A request pending for a destroyed block must be dropped without touching the deleted block.
+  blocks.back()->compressWithTemporaryBuffer(compression_buffer);
+  EXPECT_TRUE(compressor.prefetch(blocks.back().get()));
+  blocks.clear();
+  compressor.__tick(compression_buffer);
+  EXPECT_EQ(compressor.estimatedAllocationSize(), 0);
+}
+
+TEST(Compression, Policy)
+{
+  ohm::VoxelBlockCompressionQueue compressor(true);  // Instantiate in test mode
+  // Create a map in order to use the layout. DO NOT SET kCompressed. That would start a new compression object.
+  ohm::OccupancyMap map(1.0, ohm::MapFlag::kNone);
+  const ohm::MapLayer &layer = map.layout().layer(map.layout().occupancyLayer());
+  const size_t layer_mem_size = layer.layerByteSize(map.regionVoxelDimensions());
+  std::vector<ohm::VoxelBlock::Ptr> blocks;
+  std::vector<uint8_t> compression_buffer;
+
+  const size_t block_count = 10;
+  for (size_t i = 0; i < block_count; ++i)
+  {
+    blocks.emplace_back(new ohm::VoxelBlock(map.detail(), layer));
+    // The first block is the farthest, but protected.
+    blocks.back()->setCompressionHint((i > 0) ? float(i) : 100.0f, i == 0);  // NOLINT(readability-magic-numbers)
+    compressor.push(blocks.back().get());
+  }
+
+  // Compress three blocks, farthest first.
+  compressor.setPriorityPolicy(ohm::CompressionPolicy::kFarthestFirst);
+  compressor.setHighTide(0);
+  compressor.setLowTide(uint64_t(double(block_count - 2.5) * double(layer_mem_size)));
+  compressor.__tick(compression_buffer);
+  for (size_t i = 0; i < block_count; ++i)
+  {
+    EXPECT_EQ(bool(blocks[i]->flags() & ohm::VoxelBlock::kFUncompressed), i < block_count - 3) << i;
+  }
+  EXPECT_EQ(compressor.statistics().compressed_count, 3u);
+  EXPECT_EQ(compressor.statistics().thrash_count, 0u);
+
+  // Decompress a block soon after compression. The next cycle should see the thrashing.
+  blocks.back()->retain();
+  blocks.back()->release();
+  compressor.setHighTide(std::numeric_limits<uint64_t>::max());
+  compressor.__tick(compression_buffer);
+  EXPECT_EQ(compressor.statistics().decompressed_count, 1u);
+  EXPECT_EQ(compressor.statistics().thrash_count, 1u);
+
+  compressor.resetStatistics();
+  EXPECT_EQ(compressor.statistics().compressed_count, 0u);
+}
@@ -6,12 +6,18 @@
 #include "OhmTestConfig.h"
 
 #include <ohm/Aabb.h>
+#include <ohm/CompareMaps.h>
 #include <ohm/CopyUtil.h>
+#include <ohm/DefaultLayer.h>
 #include <ohm/Key.h>
 #include <ohm/LineQuery.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelBlock.h>
 #include <ohm/VoxelData.h>
+#include <ohm/VoxelOccupancy.h>
 
 #include <ohmtools/OhmCloud.h>
 #include <ohmtools/OhmGen.h>
@@ -325,4 +331,95 @@ TEST(Copy, LayerFilter)
     }
   }
 }
+
+
+TEST(Copy, CopyParallelCompressed)
+{
+  ohm::OccupancyMap map(0.2);
+  ohm::OccupancyMap dst_map(map.resolution());
+
+  // Generate occupancy.
+  const double box_size = 5.0;
+  ohmgen::boxRoom(map, glm::dvec3(-box_size), glm::dvec3(box_size));
+
+  // Compress all the source blocks.
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    for (const auto &voxel_block : chunk->voxel_blocks)
+    {
+      voxel_block->compress();
+    }
+  }
+
+  // Copy in parallel. Compressed blocks are copied as stored.
+  EXPECT_TRUE(ohm::copyMap(dst_map, map, {}, {}, ohm::kCopyParallel));
+  const int occupancy_layer = dst_map.layout().occupancyLayer();
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    const ohm::MapChunk *dst_chunk = dst_map.region(chunk->region.coord);
+    ASSERT_NE(dst_chunk, nullptr);
+    EXPECT_EQ(dst_chunk->voxel_blocks[occupancy_layer]->flags() & ohm::VoxelBlock::kFUncompressed,
+              chunk->voxel_blocks[occupancy_layer]->flags() & ohm::VoxelBlock::kFUncompressed);
+  }
+
+  // Compare maps.
+  ohmtestutil::compareMaps(dst_map, map, ohmtestutil::kCfCompareExtended);
+}
+
+
+TEST(Copy, CompareVoxels)
+{
+  ohm::OccupancyMap map(0.25);
+
+  // Generate occupancy.
+  const double box_size = 5.0;
+  ohmgen::boxRoom(map, glm::dvec3(-box_size), glm::dvec3(box_size));
+
+  const std::unique_ptr<ohm::OccupancyMap> map_copy(map.clone());
+  const std::string layer_name = ohm::default_layer::occupancyLayerName();
+  const size_t voxel_count = map.regionCount() * map.regionVoxelVolume();
+
+  // Identical maps pass without voxel comparison.
+  ohm::compare::VoxelsOptions options;
+  options.flags = ohm::compare::kContinue | ohm::compare::kParallel;
+  ohm::compare::VoxelsResult result = ohm::compare::compareVoxels(*map_copy, map, layer_name, options);
+  EXPECT_TRUE(result);
+  EXPECT_EQ(result.voxels_passed, voxel_count);
+  EXPECT_EQ(result.regions_skipped, map.regionCount());
+
+  // Modify two voxels in one region of the copy. Only that region is compared.
+  const ohm::Key modified_key = map.voxelKey(glm::dvec3(0));
+  ohm::integrateHit(*map_copy, modified_key);
+  ohm::integrateHit(*map_copy, map.voxelKey(glm::dvec3(map.resolution(), 0, 0)));
+
+  result = ohm::compare::compareVoxels(*map_copy, map, layer_name, options);
+  EXPECT_FALSE(result);
+  EXPECT_EQ(result.voxels_failed, 2u);
+  EXPECT_EQ(result.voxels_passed + result.voxels_failed, voxel_count);
+  EXPECT_EQ(result.regions_skipped + 1, map.regionCount());
+
+  // Region hashes must give the same results.
+  ohm::compare::RegionHashes eval_hashes;
+  ohm::compare::RegionHashes ref_hashes;
+  ASSERT_TRUE(ohm::compare::regionHashes(*map_copy, layer_name, eval_hashes, ohm::compare::kParallel));
+  ASSERT_TRUE(ohm::compare::regionHashes(map, layer_name, ref_hashes));
+  EXPECT_EQ(eval_hashes.size(), map.regionCount());
+  EXPECT_NE(eval_hashes[modified_key.regionKey()], ref_hashes[modified_key.regionKey()]);
+  options.eval_hashes = &eval_hashes;
+  options.ref_hashes = &ref_hashes;
+  const ohm::compare::VoxelsResult hashed_result = ohm::compare::compareVoxels(*map_copy, map, layer_name, options);
+  EXPECT_EQ(hashed_result.voxels_passed, result.voxels_passed);
+  EXPECT_EQ(hashed_result.voxels_failed, result.voxels_failed);
+  EXPECT_EQ(hashed_result.regions_skipped, result.regions_skipped);
+
+  // Early termination.
+  options.flags = ohm::compare::kContinue;
+  options.max_failures = 1;
+  result = ohm::compare::compareVoxels(*map_copy, map, layer_name, options);
+  EXPECT_EQ(result.voxels_failed, 1u);
+  result = ohm::compare::compareVoxels(*map_copy, map, layer_name, nullptr, 0);
+  EXPECT_EQ(result.voxels_failed, 1u);
+}
 }  // namespace maptests
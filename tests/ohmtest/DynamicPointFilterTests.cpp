@@ -0,0 +1,119 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohm/DynamicPointFilter.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace dynamicpointfiltertests
+{
+/// Repeatedly observe a wall at x = 2.05 from near the origin, so the space before the wall is confidently free.
+void buildStaticMap(ohm::OccupancyMap &map)
+{
+  std::vector<glm::dvec3> rays;
+  for (double y = -0.95; y < 1.0; y += 0.1)
+  {
+    for (double z = -0.95; z < 1.0; z += 0.1)
+    {
+      rays.emplace_back(glm::dvec3(0.05, 0.05, 0.05));
+      rays.emplace_back(glm::dvec3(2.05, y, z));
+    }
+  }
+
+  ohm::RayMapperOccupancy mapper(&map);
+  for (int i = 0; i < 10; ++i)
+  {
+    mapper.integrateRays(rays.data(), rays.size());
+  }
+}
+
+
+TEST(DynamicPointFilter, Classify)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  buildStaticMap(map);
+
+  ohm::DynamicPointFilter filter(map);
+  EXPECT_TRUE(filter.isDynamic(glm::dvec3(1.05, 0.05, 0.05)));
+  // Static surface.
+  EXPECT_FALSE(filter.isDynamic(glm::dvec3(2.05, 0.05, 0.05)));
+  // Adjacent to the static surface.
+  EXPECT_FALSE(filter.isDynamic(glm::dvec3(1.95, 0.05, 0.05)));
+  // Unobserved.
+  EXPECT_FALSE(filter.isDynamic(glm::dvec3(-3.0, 0.05, 0.05)));
+
+  // Serial and threaded filtering agree.
+  std::mt19937 rand_engine(42u);
+  std::uniform_real_distribution<double> rand(-2.5, 2.5);
+  std::vector<glm::dvec3> rays;
+  for (size_t i = 0; i < 1000u; ++i)
+  {
+    rays.emplace_back(glm::dvec3(0.05, 0.05, 0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  std::vector<unsigned> flags(rays.size() / 2, 0u);
+  filter.filter(rays.data(), flags.data(), flags.size());
+  const std::vector<size_t> threaded = filter.dynamicRays();
+  EXPECT_FALSE(threaded.empty());
+  for (size_t i = 0; i < flags.size(); ++i)
+  {
+    EXPECT_EQ((flags[i] & ohm::kRffClippedEnd) != 0, filter.isDynamic(rays[i * 2 + 1]));
+  }
+
+  ohm::DynamicPointFilterParams params;
+  params.use_threads = false;
+  params.action = ohm::DynamicPointAction::kCullRay;
+  filter.setParams(params);
+  std::fill(flags.begin(), flags.end(), 0u);
+  filter.filter(rays.data(), flags.data(), flags.size());
+  EXPECT_EQ(filter.dynamicRays(), threaded);
+  for (const size_t index : threaded)
+  {
+    EXPECT_NE(flags[index] & ohm::kRffInvalid, 0u);
+  }
+  EXPECT_EQ(filter.totalCheckedCount(), 2 * flags.size());
+  EXPECT_EQ(filter.totalDynamicCount(), 2 * threaded.size());
+}
+
+
+TEST(DynamicPointFilter, Integrate)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  buildStaticMap(map);
+
+  ohm::DynamicPointFilter filter(map);
+  filter.install(map);
+
+  // A moving object in free space and a static return.
+  const glm::dvec3 rays[] = { glm::dvec3(0.05, 0.05, 0.05), glm::dvec3(1.05, 0.05, 0.05),  //
+                              glm::dvec3(0.05, 0.05, 0.05), glm::dvec3(2.05, 0.35, 0.05),  //
+                              glm::dvec3(0.05, 0.05, 0.05), glm::dvec3(1.05, 0.05, 0.05) };
+  ohm::RayMapperOccupancy mapper(&map);
+  for (int i = 0; i < 5; ++i)
+  {
+    mapper.integrateRays(rays, 6);
+    EXPECT_EQ(filter.dynamicRays(), std::vector<size_t>({ 0u, 2u }));
+  }
+
+  ohm::Voxel<const float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(rays[1]));
+  EXPECT_TRUE(ohm::isFree(voxel));
+  voxel.setKey(map.voxelKey(rays[3]));
+  EXPECT_TRUE(ohm::isOccupied(voxel));
+
+  // The chained default filter still culls bad rays.
+  const glm::dvec3 bad_rays[] = { glm::dvec3(0.0), glm::dvec3(std::numeric_limits<double>::quiet_NaN()) };
+  mapper.integrateRays(bad_rays, 2);
+  EXPECT_TRUE(filter.dynamicRays().empty());
+}
+}  // namespace dynamicpointfiltertests
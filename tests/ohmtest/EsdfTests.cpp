@@ -0,0 +1,204 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/EsdfProcess.h>
+#include <ohm/KeyList.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelData.h>
+#include <ohm/VoxelEsdf.h>
+
+#include <ohmutil/GlmStream.h>
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace esdf
+{
+/// Validate the ESDF layer in @p map against a brute force calculation of the nearest occupied voxel.
+void validateEsdf(const ohm::OccupancyMap &map, float max_distance, float tolerance)
+{
+  std::vector<ohm::Key> obstacles;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer(), *iter);
+    if (ohm::isOccupied(occupancy))
+    {
+      obstacles.emplace_back(*iter);
+    }
+  }
+  ASSERT_FALSE(obstacles.empty());
+
+  ohm::Voxel<const ohm::VoxelEsdf> esdf(&map, map.layout().layerIndex(ohm::default_layer::esdfLayerName()));
+  ASSERT_TRUE(esdf.isLayerValid());
+
+  unsigned checked = 0;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    const glm::dvec3 centre = map.voxelCentreGlobal(*iter);
+    double expected = std::numeric_limits<double>::max();
+    for (const ohm::Key &obstacle : obstacles)
+    {
+      expected = std::min(expected, glm::length(map.voxelCentreGlobal(obstacle) - centre));
+    }
+
+    esdf.setKey(*iter);
+    ASSERT_TRUE(esdf.isValid());
+    const ohm::VoxelEsdf voxel = esdf.data();
+    if (expected > max_distance + 1e-4)
+    {
+      EXPECT_LT(voxel.distance, 0.0f) << iter->regionKey() << " " << iter->localKey();
+    }
+    else
+    {
+      ASSERT_TRUE(ohm::esdfHasObstacle(voxel)) << iter->regionKey() << " " << iter->localKey();
+      // The reported distance must be to a real obstacle.
+      ohm::Key obstacle_key = *iter;
+      map.moveKey(obstacle_key, ohm::esdfObstacleOffset(voxel));
+      ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer(), obstacle_key);
+      EXPECT_TRUE(ohm::isOccupied(occupancy)) << iter->regionKey() << " " << iter->localKey();
+      EXPECT_GE(voxel.distance, expected - 1e-4);
+      EXPECT_LE(voxel.distance, expected + tolerance);
+    }
+    ++checked;
+  }
+  EXPECT_GT(checked, 0u);
+}
+
+
+TEST(Esdf, Incremental)
+{
+  const double resolution = 0.1;
+  const float max_distance = 0.5f;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(16));
+  // Offset the map origin to trace between voxel centres.
+  map.setOrigin(glm::dvec3(-0.5 * resolution));
+
+  ohm::EsdfProcess esdf_process(max_distance, 0);
+  ohm::RayMapperOccupancy mapper(&map);
+  mapper.setChangedKeys(&esdf_process.changedKeys());
+
+  // Build a wall of obstacles at x = 1.
+  std::vector<glm::dvec3> rays;
+  for (int z = -5; z <= 5; ++z)
+  {
+    for (int y = -5; y <= 5; ++y)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(1.0, y * resolution, z * resolution));
+    }
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+  EXPECT_GT(esdf_process.changedKeys().size(), 0u);
+
+  EXPECT_EQ(esdf_process.update(map, 0), ohm::kMprUpToDate);
+  EXPECT_EQ(esdf_process.pendingCount(), 0u);
+  validateEsdf(map, max_distance, float(resolution));
+
+  // Punch a hole through the wall, turning obstacles free and extending the map beyond the wall.
+  rays.clear();
+  for (int z = -2; z <= 2; ++z)
+  {
+    for (int y = -2; y <= 2; ++y)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(2.0, 2 * y * resolution, 2 * z * resolution));
+    }
+  }
+  mapper.setUseThreads(true);
+  for (int i = 0; i < 20; ++i)
+  {
+    mapper.integrateRays(rays.data(), rays.size());
+  }
+
+  EXPECT_EQ(esdf_process.update(map, 0), ohm::kMprUpToDate);
+  EXPECT_EQ(esdf_process.pendingCount(), 0u);
+  validateEsdf(map, max_distance, float(resolution));
+
+  // The centre of the wall should no longer be an obstacle.
+  ohm::Voxel<const ohm::VoxelEsdf> esdf(&map, map.layout().layerIndex(ohm::default_layer::esdfLayerName()),
+                                        map.voxelKey(glm::dvec3(1.0, 0, 0)));
+  ASSERT_TRUE(esdf.isValid());
+  EXPECT_GT(esdf.data().distance, 0.0f);
+
+  // A full rebuild should yield the same result as the incremental update.
+  std::vector<std::pair<ohm::Key, float>> incremental_distances;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    esdf.setKey(*iter);
+    incremental_distances.emplace_back(*iter, esdf.data().distance);
+  }
+  esdf.reset();
+
+  glm::dvec3 min_ext;
+  glm::dvec3 max_ext;
+  map.calculateExtents(&min_ext, &max_ext);
+  esdf_process.calculateForExtents(map, min_ext, max_ext);
+  validateEsdf(map, max_distance, float(resolution));
+
+  esdf = ohm::Voxel<const ohm::VoxelEsdf>(&map, map.layout().layerIndex(ohm::default_layer::esdfLayerName()));
+  for (const auto &incremental : incremental_distances)
+  {
+    esdf.setKey(incremental.first);
+    EXPECT_NEAR(esdf.data().distance, incremental.second, 1e-5f);
+  }
+}
+
+
+TEST(Esdf, Rebase)
+{
+  // Validate changes pending across a map rebase are re-keyed and applied to the correct voxels.
+  const double resolution = 0.1;
+  const float max_distance = 0.5f;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(16));
+  map.setOrigin(glm::dvec3(-0.5 * resolution));
+
+  ohm::EsdfProcess esdf_process(max_distance, 0);
+  ohm::RayMapperOccupancy mapper(&map);
+  mapper.setChangedKeys(&esdf_process.changedKeys());
+
+  std::vector<glm::dvec3> rays;
+  for (int z = -5; z <= 5; ++z)
+  {
+    for (int y = -5; y <= 5; ++y)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(1.0, y * resolution, z * resolution));
+    }
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+  EXPECT_EQ(esdf_process.update(map, 0), ohm::kMprUpToDate);
+
+  // Queue changes for a second wall, then rebase before processing them.
+  rays.clear();
+  for (int z = -5; z <= 5; ++z)
+  {
+    for (int y = -5; y <= 5; ++y)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(-1.0, y * resolution, z * resolution));
+    }
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+  const size_t pending_count = esdf_process.pendingCount();
+  EXPECT_GT(pending_count, 0u);
+
+  const glm::i16vec3 rebase_key(1, -1, 0);
+  ASSERT_TRUE(map.rebaseOrigin(map.regionCentreGlobal(rebase_key)));
+  EXPECT_EQ(esdf_process.pendingCount(), pending_count);
+
+  EXPECT_EQ(esdf_process.update(map, 0), ohm::kMprUpToDate);
+  EXPECT_EQ(esdf_process.pendingCount(), 0u);
+  validateEsdf(map, max_distance, float(resolution));
+}
+}  // namespace esdf
@@ -0,0 +1,158 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohm/FrontierIndex.h>
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <unordered_set>
+#include <vector>
+
+namespace frontierindextests
+{
+/// Find the frontier voxels by a full map scan.
+std::unordered_set<ohm::Key> scanFrontiers(const ohm::OccupancyMap &map)
+{
+  std::unordered_set<ohm::Key> frontiers;
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  ohm::Voxel<const float> voxel(&map, map.layout().occupancyLayer());
+  ohm::Voxel<const float> neighbour(&map, map.layout().occupancyLayer());
+  const glm::u8vec3 dim = map.regionVoxelDimensions();
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    for (int z = 0; z < dim.z; ++z)
+    {
+      for (int y = 0; y < dim.y; ++y)
+      {
+        for (int x = 0; x < dim.x; ++x)
+        {
+          const ohm::Key key(chunk->region.coord, uint8_t(x), uint8_t(y), uint8_t(z));
+          voxel.setKey(key);
+          if (ohm::occupancyType(voxel) != ohm::kFree)
+          {
+            continue;
+          }
+
+          for (int axis = 0; axis < 3; ++axis)
+          {
+            for (int dir = -1; dir <= 1; dir += 2)
+            {
+              ohm::Key neighbour_key = key;
+              map.stepKey(neighbour_key, axis, dir);
+              neighbour.setKey(neighbour_key);
+              const int type = ohm::occupancyType(neighbour);
+              if (type == ohm::kUnobserved || type == ohm::kNull)
+              {
+                frontiers.insert(key);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return frontiers;
+}
+
+
+std::unordered_set<ohm::Key> indexFrontiers(const ohm::FrontierIndex &index)
+{
+  std::vector<ohm::Key> keys;
+  EXPECT_EQ(index.collect(keys), index.frontierCount());
+  return std::unordered_set<ohm::Key>(keys.begin(), keys.end());
+}
+
+
+TEST(FrontierIndex, Incremental)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  // Index some existing data.
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 2.0, 200u, 1u);
+
+  ohm::FrontierIndex index(map);
+  EXPECT_GT(index.update(), 0u);
+  EXPECT_GT(index.frontierCount(), 0u);
+  EXPECT_EQ(indexFrontiers(index), scanFrontiers(map));
+
+  // No changes.
+  EXPECT_EQ(index.update(), 0u);
+
+  // Incremental updates across overlapping and new regions.
+  const glm::dvec3 origins[] = { glm::dvec3(0.5, 0.0, 0.0), glm::dvec3(3.0, -1.0, 0.5), glm::dvec3(-2.0, 2.0, -1.0) };
+  unsigned seed = 2u;
+  for (const glm::dvec3 &origin : origins)
+  {
+    ohmtestutil::integrateRandomRays(map, origin, 2.0, 200u, seed++);
+    EXPECT_GT(index.update(), 0u);
+    EXPECT_EQ(indexFrontiers(index), scanFrontiers(map));
+  }
+
+  // A rebuild yields the same frontiers.
+  const std::unordered_set<ohm::Key> incremental = indexFrontiers(index);
+  index.rebuild();
+  EXPECT_EQ(indexFrontiers(index), incremental);
+  EXPECT_EQ(index.indexedRegionCount(), map.regionCount());
+}
+
+
+TEST(FrontierIndex, Rebase)
+{
+  // Validate the index is re-keyed in place by a map rebase and continues to update incrementally.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 2.0, 200u, 1u);
+
+  ohm::FrontierIndex index(map);
+  EXPECT_GT(index.update(), 0u);
+  const size_t frontier_count = index.frontierCount();
+
+  ASSERT_TRUE(map.rebaseOrigin(map.regionCentreGlobal(glm::i16vec3(2, -1, 0))));
+  // No voxel changes state, so the re-keyed regions yield no transitions.
+  EXPECT_EQ(index.update(), 0u);
+  EXPECT_EQ(index.frontierCount(), frontier_count);
+  EXPECT_EQ(index.indexedRegionCount(), map.regionCount());
+  EXPECT_EQ(indexFrontiers(index), scanFrontiers(map));
+
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(1.0, 0.5, 0.0), 2.0, 200u, 2u);
+  EXPECT_GT(index.update(), 0u);
+  EXPECT_EQ(indexFrontiers(index), scanFrontiers(map));
+}
+
+
+TEST(FrontierIndex, Clusters)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  ohm::FrontierIndex index(map);
+
+  // Two separate rays. Each free voxel along a ray is a frontier.
+  const glm::dvec3 rays[] = { glm::dvec3(0.05, 0.05, 0.05), glm::dvec3(1.05, 0.05, 0.05),  //
+                              glm::dvec3(0.05, 2.05, 0.05), glm::dvec3(0.05, 2.05, 1.05) };
+  ohm::RayMapperOccupancy(&map).integrateRays(rays, 4);
+  index.update();
+
+  std::vector<ohm::FrontierCluster> clusters;
+  ASSERT_EQ(index.cluster(clusters), 2u);
+  size_t clustered = 0;
+  for (const ohm::FrontierCluster &cluster : clusters)
+  {
+    clustered += cluster.keys.size();
+    EXPECT_GT(cluster.keys.size(), 5u);
+    const bool first_ray = cluster.centroid.y < 1.0;
+    EXPECT_NEAR(cluster.min_extents.y, first_ray ? 0.05 : 2.05, 1e-6);
+    EXPECT_NEAR(cluster.max_extents.y, first_ray ? 0.05 : 2.05, 1e-6);
+  }
+  EXPECT_EQ(clustered, index.frontierCount());
+
+  // Size filtering.
+  clusters.clear();
+  EXPECT_EQ(index.cluster(clusters, index.frontierCount()), 0u);
+}
+}  // namespace frontierindextests
@@ -6,11 +6,16 @@
 #include "OhmTestConfig.h"
 
 #include <ohm/Key.h>
+#include <ohm/KeyList.h>
+#include <ohm/KeyPacker.h>
 #include <ohm/MapChunk.h>
 #include <ohm/MapCoord.h>
 #include <ohm/OccupancyMap.h>
 
+#include <cmath>
 #include <cstdio>
+#include <random>
+#include <set>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -278,4 +283,122 @@ TEST(Keys, Quantisation)
     quantisationTest(bad_value, region_size, resolution);
   }
 }
+
+TEST(Keys, Packing)
+{
+  const KeyPacker packer(glm::u8vec3(32, 32, 32));
+  ASSERT_TRUE(packer.isValid());
+  EXPECT_EQ(packer.localBits(), 15u);
+  EXPECT_FALSE(KeyPacker(glm::u8vec3(64, 64, 64)).isValid());
+
+  const std::vector<Key> keys = { Key(0, 0, 0, 0, 0, 0),
+                                  Key(-1, 2, -3, 31, 0, 17),
+                                  Key(32767, -32767, 100, 1, 31, 31),
+                                  Key(-32767, 32767, -100, 31, 31, 0),
+                                  Key::kNull };
+  for (const Key &key : keys)
+  {
+    EXPECT_EQ(packer.unpack(packer.pack(key)), key);
+  }
+
+  // Packed keys order by region first.
+  EXPECT_LT(packer.pack(Key(0, 0, 0, 31, 31, 31)), packer.pack(Key(1, 0, 0, 0, 0, 0)));
+  EXPECT_LT(packer.pack(Key(-1, 0, 0, 31, 31, 31)), packer.pack(Key(0, 0, 0, 0, 0, 0)));
+}
+
+TEST(Keys, SortUnique)
+{
+  const glm::u8vec3 region_dim(32, 32, 32);
+  // Use more keys than the radix sort threshold, with plenty of duplicates.
+  KeyList keys;
+  std::set<Key> expected;
+  for (int i = 0; i < 2000; ++i)
+  {
+    const Key key(int16_t(i % 7 - 3), int16_t(i % 3 - 1), 0, uint8_t(i % 32), uint8_t((i * 7) % 32),
+                  uint8_t((i / 13) % 5));
+    keys.add(key);
+    expected.insert(key);
+  }
+
+  // Sorting without removal keeps all keys.
+  KeyList sorted = keys;
+  sorted.sort(region_dim);
+  EXPECT_EQ(sorted.size(), keys.size());
+
+  EXPECT_EQ(keys.sortUnique(region_dim), expected.size());
+  ASSERT_EQ(keys.size(), expected.size());
+  const KeyPacker packer(region_dim);
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    EXPECT_EQ(expected.count(keys[i]), 1u);
+    if (i > 0)
+    {
+      EXPECT_LT(packer.pack(keys[i - 1]), packer.pack(keys[i]));
+    }
+  }
+
+  // Each region has a single range after sorting.
+  std::vector<KeyList::RegionRange> ranges;
+  keys.regionRanges(&ranges);
+  EXPECT_EQ(ranges.size(), 7u * 3u);
+  size_t covered = 0;
+  for (const KeyList::RegionRange &range : ranges)
+  {
+    for (size_t i = range.begin; i < range.end; ++i)
+    {
+      EXPECT_EQ(keys[i].regionKey(), range.region_key);
+    }
+    covered += range.end - range.begin;
+  }
+  EXPECT_EQ(covered, keys.size());
+
+  // Unsupported dimensions fall back to a comparison sort.
+  KeyList fallback = sorted;
+  EXPECT_EQ(fallback.sortUnique(glm::u8vec3(255, 255, 255)), expected.size());
+  for (size_t i = 1; i < fallback.size(); ++i)
+  {
+    EXPECT_TRUE(fallback[i - 1] < fallback[i]);
+  }
+}
+
+TEST(Keys, BatchConversion)
+{
+  // Batched key conversion must exactly match voxelKey(), including points on and near region and voxel boundaries.
+  const double resolution = 0.1;
+  const glm::u8vec3 region_size(32, 32, 16);
+  OccupancyMap map(resolution, region_size);
+  map.setOrigin(glm::dvec3(0.05, -1.3, 2.0));
+
+  std::vector<glm::dvec3> points;
+  std::mt19937 rand_engine(0x5eed);
+  std::uniform_real_distribution<double> rand(-50.0, 50.0);
+  for (int i = 0; i < 10000; ++i)
+  {
+    points.emplace_back(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+  }
+
+  // Region half extents are whole voxels, so voxel boundaries lie at origin + n * resolution, with region boundaries
+  // at odd multiples of the half region voxel dimensions. Add each boundary and the adjacent representable values
+  // either side, covering several regions either side of the origin.
+  for (int n = -200; n <= 200; ++n)
+  {
+    const glm::dvec3 boundary = map.origin() + glm::dvec3(n * resolution);
+    const glm::dvec3 below(std::nextafter(boundary.x, -1e9), std::nextafter(boundary.y, -1e9),
+                           std::nextafter(boundary.z, -1e9));
+    const glm::dvec3 above(std::nextafter(boundary.x, 1e9), std::nextafter(boundary.y, 1e9),
+                           std::nextafter(boundary.z, 1e9));
+    points.emplace_back(boundary);
+    points.emplace_back(below);
+    points.emplace_back(above);
+    points.emplace_back(below.x, above.y, boundary.z);
+    points.emplace_back(above.x, boundary.y, below.z);
+  }
+
+  std::vector<Key> keys(points.size());
+  map.voxelKeys(points.data(), points.size(), keys.data());
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    EXPECT_EQ(keys[i], map.voxelKey(points[i])) << "point " << i;
+  }
+}
 }  // namespace keytests
@@ -0,0 +1,106 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/KeyRange.h>
+#include <ohm/LayerExport.h>
+#include <ohm/MapFlag.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmutil/GlmStream.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace layerexport
+{
+void testExport(ohm::MapFlag map_flags)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(8), map_flags | ohm::MapFlag::kVoxelMean);
+
+  // Observe a line of voxels crossing several regions.
+  std::vector<ohm::Key> keys;
+  for (int i = -10; i < 20; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    const glm::dvec3 pos(i * resolution + 0.01, 0.02, -0.03);  // NOLINT(readability-magic-numbers)
+    const ohm::Key key = map.voxelKey(pos);
+    ohm::integrateHit(map, key);
+    ohm::Voxel<ohm::VoxelMean> mean(&map, map.layout().meanLayer(), key);
+    ohm::updatePositionSafe(mean, pos);
+    keys.emplace_back(key);
+  }
+
+  ohm::LayerExport exporter(map);
+  ASSERT_EQ(exporter.addLayer(ohm::default_layer::occupancyLayerName()), 0);
+  ASSERT_EQ(exporter.addLayer(ohm::default_layer::meanLayerName()), 1);
+  EXPECT_EQ(exporter.addLayer(ohm::default_layer::covarianceLayerName()), -1);
+  ASSERT_EQ(exporter.columnCount(), 2u);
+
+  const ohm::KeyRange range(map.voxelKey(glm::dvec3(-5, -5, -5)), map.voxelKey(glm::dvec3(5, 5, 5)), map);
+  EXPECT_EQ(exporter.exportRange(range), keys.size());
+  ASSERT_EQ(exporter.voxelCount(), keys.size());
+  EXPECT_EQ(exporter.columnByteSize(0), keys.size() * sizeof(float));
+  EXPECT_EQ(exporter.columnByteSize(1), keys.size() * sizeof(ohm::VoxelMean));
+  EXPECT_EQ(exporter.positions(0).size(), keys.size());
+
+  // Validate each exported voxel against the map.
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::VoxelMean> mean(&map, map.layout().meanLayer());
+  for (size_t i = 0; i < exporter.voxelCount(); ++i)
+  {
+    const glm::dvec3 centre(exporter.positions(0)[i], exporter.positions(1)[i], exporter.positions(2)[i]);
+    const ohm::Key key = map.voxelKey(centre);
+    EXPECT_NE(std::find(keys.begin(), keys.end(), key), keys.end());
+    ohm::setVoxelKey(key, occupancy, mean);
+    ASSERT_TRUE(occupancy.isValid());
+    ASSERT_TRUE(mean.isValid());
+
+    float exported_occupancy = 0;
+    memcpy(&exported_occupancy, exporter.columnData(0) + i * sizeof(float), sizeof(float));
+    EXPECT_EQ(exported_occupancy, occupancy.data());
+
+    ohm::VoxelMean exported_mean{};
+    memcpy(&exported_mean, exporter.columnData(1) + i * sizeof(ohm::VoxelMean), sizeof(ohm::VoxelMean));
+    EXPECT_EQ(exported_mean.coord, mean.data().coord);
+    EXPECT_EQ(exported_mean.count, mean.data().count);
+  }
+  occupancy.reset();
+  mean.reset();
+
+  // A sub range only exports the contained voxels. Keys are in the same Y/Z plane so we can just count along X.
+  exporter.clear();
+  const ohm::KeyRange sub_range(keys[3], keys[12], map);  // NOLINT(readability-magic-numbers)
+  EXPECT_EQ(exporter.exportRange(sub_range), 10u);
+
+  // Exporting all regions with unobserved voxels gives the full region volume.
+  exporter.clear();
+  exporter.setFlags(ohm::LayerExport::kNoPositions);
+  const std::vector<glm::i16vec3> regions = { keys.front().regionKey(), glm::i16vec3(100) };
+  EXPECT_EQ(exporter.exportRegions(regions), 8u * 8u * 8u);
+  EXPECT_TRUE(exporter.positions(0).empty());
+}
+
+
+TEST(LayerExport, Export)
+{
+  testExport(ohm::MapFlag::kNone);
+}
+
+
+TEST(LayerExport, VoxelOrder)
+{
+  testExport(ohm::MapFlag::kVoxelOrderMorton);
+  testExport(ohm::MapFlag::kVoxelOrderBrick4);
+}
+}  // namespace layerexport
@@ -6,9 +6,14 @@
 #include "OhmTestConfig.h"
 
 #include <ohm/DefaultLayer.h>
+#include <ohm/MapChunk.h>
 #include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
+#include <ohm/MapSerialise.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/Voxel.h>
+#include <ohm/VoxelBlock.h>
 #include <ohm/VoxelLayout.h>
 #include <ohm/VoxelMean.h>
 
@@ -221,3 +226,129 @@ TEST(Layout, Structure)
     ++i;
   }
 }
+
+
+TEST(Layout, Interleaved)
+{
+  const MapFlag flags = MapFlag::kVoxelMean | MapFlag::kTraversal;
+  OccupancyMap separate_map(0.1, flags);
+  OccupancyMap interleaved_map(0.1, flags | MapFlag::kInterleavedLayers);
+
+  const MapLayout &layout = interleaved_map.layout();
+  ASSERT_TRUE((interleaved_map.flags() & MapFlag::kInterleavedLayers) != MapFlag::kNone);
+  const MapLayer *group_layer = layout.layer(default_layer::occupancyGroupLayerName());
+  ASSERT_NE(group_layer, nullptr);
+  EXPECT_EQ(group_layer->voxelByteSize(), sizeof(float) + sizeof(VoxelMean) + sizeof(float));
+
+  const int grouped_layers[] = { layout.occupancyLayer(), layout.meanLayer(), layout.traversalLayer() };
+  const unsigned expected_offsets[] = { 0u, unsigned(sizeof(float)), unsigned(sizeof(float) + sizeof(VoxelMean)) };
+  for (size_t i = 0; i < 3; ++i)
+  {
+    const MapLayer *layer = layout.layerPtr(grouped_layers[i]);
+    ASSERT_NE(layer, nullptr);
+    EXPECT_TRUE(layer->isGroupMember());
+    EXPECT_EQ(layer->groupLayer(), int(group_layer->layerIndex()));
+    EXPECT_EQ(layer->groupOffset(), expected_offsets[i]);
+    EXPECT_EQ(layer->voxelStride(), group_layer->voxelByteSize());
+  }
+
+  std::vector<glm::dvec3> rays;
+  std::default_random_engine rng(1153297050u);
+  std::uniform_real_distribution<double> uniform(-2.0, 2.0);
+  for (unsigned r = 0; r < 1000u; ++r)
+  {
+    rays.emplace_back(glm::dvec3(0));
+    rays.emplace_back(glm::dvec3(uniform(rng), uniform(rng), uniform(rng)));
+  }
+
+  RayMapperOccupancy(&separate_map).integrateRays(rays.data(), rays.size());
+  RayMapperOccupancy(&interleaved_map).integrateRays(rays.data(), rays.size());
+
+  const std::string map_name = "layout-interleaved.ohm";
+  ASSERT_EQ(save(map_name, interleaved_map), 0);
+  OccupancyMap loaded_map(1.0);
+  ASSERT_EQ(load(map_name, loaded_map), 0);
+  ASSERT_TRUE((loaded_map.flags() & MapFlag::kInterleavedLayers) != MapFlag::kNone);
+
+  const auto validate = [&separate_map](const OccupancyMap &map) {
+    Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+    Voxel<const VoxelMean> mean(&map, map.layout().meanLayer());
+    Voxel<const float> traversal(&map, map.layout().traversalLayer());
+    Voxel<const float> ref_occupancy(&separate_map, separate_map.layout().occupancyLayer());
+    Voxel<const VoxelMean> ref_mean(&separate_map, separate_map.layout().meanLayer());
+    Voxel<const float> ref_traversal(&separate_map, separate_map.layout().traversalLayer());
+    ASSERT_TRUE(occupancy.isLayerValid());
+    ASSERT_TRUE(mean.isLayerValid());
+    ASSERT_TRUE(traversal.isLayerValid());
+
+    size_t voxel_count = 0;
+    for (auto iter = separate_map.begin(); iter != separate_map.end(); ++iter)
+    {
+      setVoxelKey(*iter, occupancy, mean, traversal, ref_occupancy, ref_mean, ref_traversal);
+      ASSERT_TRUE(occupancy.isValid());
+      EXPECT_EQ(occupancy.data(), ref_occupancy.data());
+      EXPECT_EQ(mean.data().coord, ref_mean.data().coord);
+      EXPECT_EQ(mean.data().count, ref_mean.data().count);
+      EXPECT_EQ(traversal.data(), ref_traversal.data());
+      ++voxel_count;
+    }
+    EXPECT_GT(voxel_count, 0u);
+  };
+
+  validate(interleaved_map);
+  validate(loaded_map);
+}
+
+
+TEST(Layout, Migrate)
+{
+  // Add a layer to a populated map. Existing layers must be preserved while the new layer is lazily initialised.
+  OccupancyMap map(0.1, glm::u8vec3(16));
+  std::vector<glm::dvec3> rays;
+  std::default_random_engine rng(2019384756u);
+  std::uniform_real_distribution<double> uniform(-5.0, 5.0);
+  for (unsigned r = 0; r < 2000u; ++r)
+  {
+    rays.emplace_back(glm::dvec3(0));
+    rays.emplace_back(glm::dvec3(uniform(rng), uniform(rng), uniform(rng)));
+  }
+  RayMapperOccupancy(&map).integrateRays(rays.data(), rays.size());
+  ASSERT_GT(map.regionCount(), 1u);
+
+  OccupancyMap reference(0.1, glm::u8vec3(16));
+  RayMapperOccupancy(&reference).integrateRays(rays.data(), rays.size());
+
+  map.addTraversalLayer();
+  const int traversal_layer = map.layout().traversalLayer();
+  ASSERT_GE(traversal_layer, 0);
+
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  ASSERT_EQ(chunks.size(), map.regionCount());
+  for (const MapChunk *chunk : chunks)
+  {
+    // No voxel memory is allocated for the new layer until it is accessed.
+    EXPECT_TRUE(chunk->voxel_blocks[traversal_layer]->flags() & VoxelBlock::kFUniform);
+  }
+
+  Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  Voxel<const float> traversal(&map, traversal_layer);
+  Voxel<const float> ref_occupancy(&reference, reference.layout().occupancyLayer());
+  size_t voxel_count = 0;
+  for (auto iter = reference.begin(); iter != reference.end(); ++iter)
+  {
+    setVoxelKey(*iter, occupancy, traversal, ref_occupancy);
+    ASSERT_TRUE(occupancy.isValid());
+    ASSERT_TRUE(traversal.isValid());
+    EXPECT_EQ(occupancy.data(), ref_occupancy.data());
+    EXPECT_EQ(traversal.data(), 0.0f);
+    ++voxel_count;
+  }
+  EXPECT_GT(voxel_count, 0u);
+  occupancy.reset();
+  traversal.reset();
+  ref_occupancy.reset();
+
+  // Accessed blocks are expanded and remain dense as the map does not use MapFlag::kUniformBlocks.
+  EXPECT_FALSE(chunks.front()->voxel_blocks[traversal_layer]->flags() & VoxelBlock::kFUniform);
+}
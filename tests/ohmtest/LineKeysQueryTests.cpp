@@ -0,0 +1,68 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/CalculateSegmentKeys.h>
+#include <ohm/KeyList.h>
+#include <ohm/LineKeysQuery.h>
+#include <ohm/OccupancyMap.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <random>
+#include <vector>
+
+namespace linekeysquerytests
+{
+void validateResults(const ohm::LineKeysQuery &query, const std::vector<glm::dvec3> &rays)
+{
+  ASSERT_EQ(query.numberOfResults(), rays.size() / 2);
+  ohm::KeyList keys;
+  for (size_t r = 0; r < query.numberOfResults(); ++r)
+  {
+    ohm::calculateSegmentKeys(keys, *query.map(), rays[r * 2 + 0], rays[r * 2 + 1], true);
+    ASSERT_EQ(query.resultCounts()[r], keys.size()) << r;
+    const ohm::Key *result_keys = query.intersectedVoxels() + query.resultIndices()[r];
+    for (size_t k = 0; k < keys.size(); ++k)
+    {
+      ASSERT_EQ(result_keys[k], keys.at(k)) << r << ":" << k;
+    }
+  }
+}
+
+
+TEST(LineKeysQuery, Threads)
+{
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  const double resolution = 0.1;
+  // Use enough rays for several calculation blocks.
+  const unsigned ray_count = 5000;
+  ohm::OccupancyMap map(resolution);
+
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-5.0, 5.0);
+  std::vector<glm::dvec3> rays;
+  for (unsigned i = 0; i < ray_count * 2; ++i)
+  {
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  for (bool use_threads : { false, true })
+  {
+    ohm::LineKeysQuery query(map);
+    query.setUseThreads(use_threads);
+    query.setRays(rays.data(), rays.size());
+    ASSERT_TRUE(query.execute());
+    validateResults(query, rays);
+
+    ASSERT_TRUE(query.executeAsync());
+    ASSERT_TRUE(query.wait());
+    validateResults(query, rays);
+  }
+}
+}  // namespace linekeysquerytests
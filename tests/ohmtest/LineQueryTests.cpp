@@ -8,11 +8,15 @@
 #include <ohm/Key.h>
 #include <ohm/KeyList.h>
 #include <ohm/LineQuery.h>
+#include <ohm/MapChunk.h>
 #include <ohm/MapSerialise.h>
+#include <ohm/NearestNeighbours.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/OccupancySummary.h>
 #include <ohm/OccupancyType.h>
 #include <ohm/OccupancyUtil.h>
 #include <ohm/VoxelData.h>
+#include <ohm/VoxelRangeCache.h>
 
 #include <logutil/LogUtil.h>
 
@@ -83,4 +87,194 @@ TEST(LineQuery, Cpu)
   sparseMap(map);
   lineQueryTest(map);
 }
+
+TEST(LineQuery, OccupancySummary)
+{
+  // Build matching maps with and without the occupancy summary. The query results must match.
+  OccupancyMap dense_map(0.1);
+  OccupancyMap summary_map(0.1, MapFlag::kDefault | MapFlag::kOccupancySummary);
+  std::mt19937 rng(1234u);
+  std::uniform_real_distribution<double> rand(-3.0, 3.0);
+  std::vector<glm::dvec3> hits;
+  for (int i = 0; i < 20; ++i)
+  {
+    hits.emplace_back(glm::dvec3(rand(rng), rand(rng), 0.2 * rand(rng)));
+  }
+
+  for (OccupancyMap *map : { &dense_map, &summary_map })
+  {
+    sparseMap(*map);
+    Voxel<float> voxel(map, map->layout().occupancyLayer());
+    for (const glm::dvec3 &hit : hits)
+    {
+      voxel.setKey(map->voxelKey(hit));
+      integrateHit(voxel);
+    }
+  }
+
+  // Validate the summary for the origin region.
+  MapChunk *chunk = summary_map.region(summary_map.voxelKey(glm::dvec3(0)).regionKey());
+  ASSERT_NE(chunk, nullptr);
+  EXPECT_EQ(currentOccupancySummary(*chunk), nullptr);
+  const RegionOccupancySummary *summary = updateOccupancySummary(*chunk);
+  ASSERT_NE(summary, nullptr);
+  EXPECT_EQ(summary, currentOccupancySummary(*chunk));
+  EXPECT_EQ(updateOccupancySummary(*dense_map.region(chunk->region.coord)), nullptr);
+  EXPECT_EQ(summary->brickSize(summary->levelCount() - 1), 32);
+  EXPECT_TRUE(summary->regionBrick().mayContainOccupied(summary_map.occupancyThresholdValue(), false));
+  EXPECT_FALSE(summary->regionBrick().isUnobserved());
+  // Free space next to the occupied voxel is skipped to the end of its brick, but not the occupied voxel.
+  const glm::ivec3 occupied_key(summary_map.voxelKey(glm::dvec3(0)).localKey());
+  EXPECT_EQ(summary->emptyRunLength(occupied_key, summary_map.occupancyThresholdValue(), false), 0);
+
+  // Modifying a voxel invalidates the summary.
+  {
+    Voxel<float> voxel(&summary_map, summary_map.layout().occupancyLayer(),
+                       summary_map.voxelKey(glm::dvec3(0.05, 0.55, 0.05)));
+    integrateMiss(voxel);
+  }
+  EXPECT_EQ(currentOccupancySummary(*chunk), nullptr);
+  {
+    Voxel<float> voxel(&dense_map, dense_map.layout().occupancyLayer(),
+                       dense_map.voxelKey(glm::dvec3(0.05, 0.55, 0.05)));
+    integrateMiss(voxel);
+  }
+
+  // Compare line queries.
+  for (const glm::dvec3 &hit : hits)
+  {
+    LineQuery dense_query(dense_map, glm::dvec3(0), hit, 0.5f);
+    LineQuery summary_query(summary_map, glm::dvec3(0), hit, 0.5f);
+    ASSERT_TRUE(dense_query.execute());
+    ASSERT_TRUE(summary_query.execute());
+    ASSERT_EQ(dense_query.numberOfResults(), summary_query.numberOfResults());
+    for (size_t i = 0; i < dense_query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(dense_query.intersectedVoxels()[i], summary_query.intersectedVoxels()[i]);
+      EXPECT_EQ(dense_query.ranges()[i], summary_query.ranges()[i]);
+    }
+  }
+
+  // Compare nearest neighbours queries.
+  for (const glm::dvec3 &hit : hits)
+  {
+    NearestNeighbours dense_query(dense_map, hit, 1.0f, 0);
+    NearestNeighbours summary_query(summary_map, hit, 1.0f, 0);
+    ASSERT_TRUE(dense_query.execute());
+    ASSERT_TRUE(summary_query.execute());
+    ASSERT_EQ(dense_query.numberOfResults(), summary_query.numberOfResults());
+    EXPECT_GT(summary_query.numberOfResults(), 0u);
+    for (size_t i = 0; i < dense_query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(dense_query.intersectedVoxels()[i], summary_query.intersectedVoxels()[i]);
+      EXPECT_EQ(dense_query.ranges()[i], summary_query.ranges()[i]);
+    }
+  }
+  EXPECT_NE(currentOccupancySummary(*chunk), nullptr);
+
+  // Asynchronous execution matches synchronous execution.
+  for (const glm::dvec3 &hit : hits)
+  {
+    LineQuery line_query(summary_map, glm::dvec3(0), hit, 0.5f);
+    LineQuery line_query_async(summary_map, glm::dvec3(0), hit, 0.5f);
+    NearestNeighbours nn_query(summary_map, hit, 1.0f, 0);
+    NearestNeighbours nn_query_async(summary_map, hit, 1.0f, 0);
+    ASSERT_TRUE(line_query.execute());
+    ASSERT_TRUE(nn_query.execute());
+    ASSERT_TRUE(line_query_async.executeAsync());
+    ASSERT_TRUE(nn_query_async.executeAsync());
+    ASSERT_TRUE(line_query_async.wait());
+    ASSERT_TRUE(nn_query_async.wait());
+    ASSERT_EQ(line_query.numberOfResults(), line_query_async.numberOfResults());
+    for (size_t i = 0; i < line_query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(line_query.intersectedVoxels()[i], line_query_async.intersectedVoxels()[i]);
+      EXPECT_EQ(line_query.ranges()[i], line_query_async.ranges()[i]);
+    }
+    ASSERT_EQ(nn_query.numberOfResults(), nn_query_async.numberOfResults());
+    for (size_t i = 0; i < nn_query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(nn_query.intersectedVoxels()[i], nn_query_async.intersectedVoxels()[i]);
+      EXPECT_EQ(nn_query.ranges()[i], nn_query_async.ranges()[i]);
+    }
+  }
+}
+
+
+TEST(LineQuery, RangeCache)
+{
+  // Queries using a shared range cache must match uncached queries, including after the map changes.
+  OccupancyMap map(0.1);
+  ohmgen::fillMapWithEmptySpace(map, -20, -20, -5, 19, 19, 4);
+  std::mt19937 rng(4321u);
+  std::uniform_real_distribution<double> rand(-1.8, 1.8);
+  std::vector<glm::dvec3> points;
+  for (int i = 0; i < 10; ++i)
+  {
+    points.emplace_back(glm::dvec3(rand(rng), rand(rng), 0.1 * rand(rng)));
+  }
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer());
+    for (size_t i = 0; i < points.size(); i += 2)
+    {
+      voxel.setKey(map.voxelKey(points[i]));
+      integrateHit(voxel);
+    }
+  }
+
+  VoxelRangeCache cache;
+  const auto compare_queries = [&]() {
+    for (size_t i = 1; i < points.size(); ++i)
+    {
+      LineQuery reference(map, points[i - 1], points[i], 0.5f);
+      LineQuery cached(map, points[i - 1], points[i], 0.5f, 0u);
+      cached.setRangeCache(&cache);
+      EXPECT_EQ(cached.rangeCache(), &cache);
+      ASSERT_TRUE(reference.execute());
+      ASSERT_TRUE(cached.execute());
+      ASSERT_EQ(reference.numberOfResults(), cached.numberOfResults());
+      for (size_t j = 0; j < reference.numberOfResults(); ++j)
+      {
+        EXPECT_EQ(reference.intersectedVoxels()[j], cached.intersectedVoxels()[j]);
+        EXPECT_EQ(reference.ranges()[j], cached.ranges()[j]);
+      }
+    }
+  };
+
+  compare_queries();
+  const uint64_t first_misses = cache.missCount();
+  EXPECT_GT(first_misses, 0u);
+  EXPECT_GT(cache.regionCount(), 0u);
+
+  // Repeating the queries over the unchanged map only hits the cache.
+  const uint64_t first_hits = cache.hitCount();
+  compare_queries();
+  EXPECT_EQ(cache.missCount(), first_misses);
+  EXPECT_GT(cache.hitCount(), first_hits);
+  EXPECT_EQ(cache.invalidationCount(), 0u);
+
+  // Add obstacles along the lines. The affected regions must be invalidated.
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer());
+    for (size_t i = 1; i < points.size(); i += 2)
+    {
+      voxel.setKey(map.voxelKey(0.5 * (points[i - 1] + points[i])));
+      integrateHit(voxel);
+    }
+  }
+  compare_queries();
+  EXPECT_GT(cache.invalidationCount(), 0u);
+  EXPECT_GT(cache.missCount(), first_misses);
+
+  // The cache is not used with kQfNoCache.
+  const uint64_t hits = cache.hitCount();
+  LineQuery uncached(map, points[0], points[1], 0.5f);
+  uncached.setRangeCache(&cache);
+  ASSERT_TRUE(uncached.execute());
+  EXPECT_EQ(cache.hitCount(), hits);
+
+  cache.clear();
+  EXPECT_EQ(cache.regionCount(), 0u);
+  EXPECT_EQ(cache.hitCount(), 0u);
+}
 }  // namespace linequerytests
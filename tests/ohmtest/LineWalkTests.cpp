@@ -289,4 +289,59 @@ TEST(LineWalk, Walk)
   }
   std::cout << std::setprecision(restore_precision);
 }
+
+
+TEST(LineWalk, Batch)
+{
+  // Validate calculateSegmentKeysBatch() against calculateSegmentKeys().
+  const unsigned ray_count = 1000;
+  OccupancyMap map(0.1, glm::u8vec3(8));
+  std::vector<glm::dvec3> rays;
+  uint32_t seed = 1153297050u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<double> uniform(-3.0, 3.0);
+  std::uniform_real_distribution<double> scale(0.0, 1.0);
+
+  for (unsigned i = 0; i < ray_count; ++i)
+  {
+    // Vary the ray lengths so lanes are refilled at different times.
+    const glm::dvec3 start(uniform(rng), uniform(rng), uniform(rng));
+    const glm::dvec3 end(uniform(rng), uniform(rng), uniform(rng));
+    rays.emplace_back(start);
+    rays.emplace_back(start + scale(rng) * scale(rng) * (end - start));
+  }
+  // Add degenerate and out of range rays.
+  rays.emplace_back(glm::dvec3(0.05));
+  rays.emplace_back(glm::dvec3(0.051));
+  rays.emplace_back(glm::dvec3(0.0));
+  rays.emplace_back(glm::dvec3(1e9));
+
+  const size_t batch_ray_count = rays.size() / 2;
+  KeyList expected;
+  std::vector<KeyList> batch_keys(batch_ray_count);
+  SegmentKeys flat_keys;
+  for (bool include_end_point : { true, false })
+  {
+    const size_t key_count =
+      calculateSegmentKeysBatch(batch_keys.data(), map, rays.data(), rays.size(), include_end_point);
+    const size_t flat_key_count =
+      calculateSegmentKeysBatch(flat_keys, map, rays.data(), rays.size(), include_end_point);
+    EXPECT_EQ(flat_key_count, key_count);
+    ASSERT_EQ(flat_keys.keys.size(), key_count);
+
+    size_t expected_count = 0;
+    for (size_t i = 0; i < batch_ray_count; ++i)
+    {
+      expected_count += calculateSegmentKeys(expected, map, rays[i * 2 + 0], rays[i * 2 + 1], include_end_point);
+      ASSERT_EQ(batch_keys[i].size(), expected.size()) << "ray " << i;
+      ASSERT_EQ(flat_keys.ray_counts[i], expected.size()) << "ray " << i;
+      for (size_t k = 0; k < expected.size(); ++k)
+      {
+        EXPECT_EQ(batch_keys[i].at(k), expected.at(k)) << "ray " << i << " key " << k;
+        EXPECT_EQ(flat_keys.keys[flat_keys.ray_offsets[i] + k], expected.at(k)) << "ray " << i << " key " << k;
+      }
+    }
+    EXPECT_EQ(key_count, expected_count);
+  }
+}
 }  // namespace linewalktests
@@ -0,0 +1,131 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include <logutil/Logger.h>
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace loggertests
+{
+/// Logging interface which records messages.
+class LogCapture : public logutil::LogInterface
+{
+public:
+  LogCapture()
+    : logutil::LogInterface(logutil::LogLevel::kTrace)
+  {}
+
+  void message(logutil::LogLevel level, const char *msg) override
+  {
+    (void)level;
+    std::unique_lock<std::mutex> guard(mutex);
+    messages.emplace_back(msg);
+  }
+
+  std::vector<std::string> messages;
+  std::mutex mutex;
+};
+
+
+/// A type without native deferred encoding.
+struct Point
+{
+  int x;
+  int y;
+};
+
+
+std::ostream &operator<<(std::ostream &out, const Point &point)
+{
+  out << '(' << point.x << ',' << point.y << ')';
+  return out;
+}
+
+
+TEST(Logger, AsyncFormat)
+{
+  LogCapture capture;
+  logutil::LogAsync async_logger(&capture, 8);
+  EXPECT_EQ(async_logger.capacity(), 8u);
+  // Log via the base interface to select the logging helper overloads which take a logger argument.
+  logutil::LogInterface *log = &async_logger;
+
+  const std::string text = "text";
+  const Point point{ 1, -2 };
+  logutil::info(log, "int ", -42, " unsigned ", 42u, " double ", 1.5, " bool ", true, " char ", 'c', ' ',
+                text, ' ', point, '\n');
+  async_logger.message(logutil::LogLevel::kWarn, "preformatted\n");
+  async_logger.flush();
+
+  // Expect the same output as synchronous formatting.
+  std::ostringstream expected;
+  logutil::logger_detail::prepareStream(expected);
+  expected << "int " << -42 << " unsigned " << 42u << " double " << 1.5 << " bool " << true << " char " << 'c' << ' '
+           << text << ' ' << point << '\n';
+
+  ASSERT_EQ(capture.messages.size(), 2u);
+  EXPECT_EQ(capture.messages[0], expected.str());
+  EXPECT_EQ(capture.messages[1], "preformatted\n");
+
+  // Overflow a slot.
+  const std::string long_text(logutil::LogAsync::kSlotSize * 2, 'x');
+  logutil::info(log, long_text, '\n');
+  async_logger.flush();
+  ASSERT_EQ(capture.messages.size(), 3u);
+  EXPECT_EQ(async_logger.truncatedCount(), 1u);
+  EXPECT_LT(capture.messages[2].size(), long_text.size());
+}
+
+
+TEST(Logger, AsyncThreads)
+{
+  // Log from multiple threads through a small ring buffer and validate the messages from each thread are in order.
+  const unsigned thread_count = std::max(2u, std::thread::hardware_concurrency());
+  const unsigned message_count = 1000u;
+  LogCapture capture;
+  {
+    logutil::LogAsync async_logger(&capture, 16);
+    logutil::LogInterface *log = &async_logger;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; ++t)
+    {
+      threads.emplace_back([log, t, message_count]() {
+        for (unsigned i = 0; i < message_count; ++i)
+        {
+          logutil::trace(log, t, ' ', i);
+        }
+      });
+    }
+
+    for (auto &thread : threads)
+    {
+      thread.join();
+    }
+    // Destructor delivers the remaining messages.
+  }
+
+  ASSERT_EQ(capture.messages.size(), size_t(thread_count) * message_count);
+  std::vector<unsigned> next(thread_count, 0u);
+  for (const auto &msg : capture.messages)
+  {
+    std::istringstream in(msg);
+    unsigned t = 0;
+    unsigned i = 0;
+    in >> t >> i;
+    ASSERT_LT(t, thread_count);
+    EXPECT_EQ(i, next[t]);
+    next[t] = i + 1;
+  }
+}
+}  // namespace loggertests
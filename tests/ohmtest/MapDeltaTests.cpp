@@ -0,0 +1,128 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapDelta.h>
+#include <ohm/MapSerialise.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelOccupancy.h>
+
+#include <ohmtools/OhmGen.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace mapdeltatests
+{
+/// Encode the next message from @p encoder and apply it to @p remote .
+/// @return The number of regions sent.
+size_t stream(ohm::MapDeltaEncoder &encoder, const ohm::OccupancyMap &map, ohm::OccupancyMap &remote,
+              size_t *message_size = nullptr)
+{
+  size_t region_count = 0;
+  std::vector<uint8_t> message;
+  const int err = encoder.encode(
+    map,
+    [&message](const uint8_t *data, size_t byte_count) {
+      message.assign(data, data + byte_count);
+      return true;
+    },
+    &region_count);
+  EXPECT_EQ(err, ohm::kSeOk);
+  EXPECT_EQ(message.empty(), region_count == 0);
+  if (!message.empty())
+  {
+    uint64_t stamp = 0;
+    EXPECT_EQ(ohm::applyMapDelta(remote, message.data(), message.size(), &stamp), ohm::kSeOk);
+    EXPECT_EQ(stamp, map.stamp());
+  }
+  if (message_size)
+  {
+    *message_size = message.size();
+  }
+  return region_count;
+}
+
+
+TEST(MapDelta, Stream)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohm::OccupancyMap remote(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohmgen::boxRoom(map, glm::dvec3(-2.5), glm::dvec3(2.5));
+
+  ohm::MapDeltaEncoder encoder;
+  EXPECT_EQ(stream(encoder, map, remote), map.regionCount());
+  EXPECT_EQ(encoder.pendingCount(), 0u);
+  ohmtestutil::compareMaps(remote, map, ohmtestutil::kCfCompareExtended);
+
+  // No changes: nothing sent.
+  EXPECT_EQ(stream(encoder, map, remote), 0u);
+
+  // Only changed regions are sent.
+  const ohm::Key key = map.voxelKey(glm::dvec3(0.1));
+  ohm::integrateHit(map, key);
+  EXPECT_EQ(stream(encoder, map, remote), 1u);
+  ohmtestutil::compareMaps(remote, map, ohmtestutil::kCfCompareExtended);
+
+  // A mismatched map is rejected.
+  ohm::OccupancyMap other(0.5, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  std::vector<uint8_t> message;
+  encoder.reset();
+  encoder.encode(map, [&message](const uint8_t *data, size_t byte_count) {
+    message.assign(data, data + byte_count);
+    return true;
+  });
+  EXPECT_EQ(ohm::applyMapDelta(other, message.data(), message.size()), ohm::kSeJournalMismatch);
+}
+
+
+TEST(MapDelta, Budget)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohm::OccupancyMap remote(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohmgen::boxRoom(map, glm::dvec3(-2.5), glm::dvec3(2.5));
+
+  // A tiny budget sends one region per message, nearest the reference position first.
+  ohm::MapDeltaEncoder encoder;
+  encoder.setByteBudget(1);
+  encoder.setReferencePosition(glm::dvec3(0));
+
+  const size_t region_count = map.regionCount();
+  for (size_t i = 0; i < region_count; ++i)
+  {
+    EXPECT_EQ(stream(encoder, map, remote), 1u);
+    EXPECT_EQ(encoder.pendingCount(), region_count - i - 1);
+    EXPECT_EQ(remote.regionCount(), i + 1);
+  }
+  EXPECT_EQ(stream(encoder, map, remote), 0u);
+  ohmtestutil::compareMaps(remote, map, ohmtestutil::kCfCompareExtended);
+
+  // A failed send requeues the regions.
+  encoder.reset();
+  encoder.setByteBudget(0);
+  EXPECT_EQ(encoder.encode(map, [](const uint8_t *, size_t) { return false; }), ohm::kSeFileWriteFailure);
+  EXPECT_EQ(encoder.pendingCount(), region_count);
+
+  // A moderate budget limits the message size while more than one region fits.
+  size_t message_size = 0;
+  const size_t budget = 4 * 1024;
+  encoder.setByteBudget(budget);
+  size_t sent_count = 0;
+  while (encoder.pendingCount())
+  {
+    const size_t sent = stream(encoder, map, remote, &message_size);
+    ASSERT_GT(sent, 0u);
+    EXPECT_TRUE(sent == 1 || message_size <= budget);
+    sent_count += sent;
+  }
+  EXPECT_EQ(sent_count, region_count);
+}
+}  // namespace mapdeltatests
@@ -0,0 +1,179 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <ohm/CovarianceVoxel.h>
+#include <ohm/DefaultLayer.h>
+#include <ohm/Key.h>
+#include <ohm/MapMerge.h>
+#include <ohm/MapSerialise.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelMean.h>
+#include <ohm/VoxelOccupancy.h>
+
+#include <ohmtools/OhmGen.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mapmergetests
+{
+float occupancy(const ohm::OccupancyMap &map, const glm::dvec3 &point)
+{
+  ohm::Voxel<const float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(point));
+  return voxel.isValid() ? voxel.data() : ohm::unobservedOccupancyValue();
+}
+
+
+TEST(MapMerge, Occupancy)
+{
+  ohm::OccupancyMap dst(0.1, glm::u8vec3(16), ohm::MapFlag::kVoxelMean);
+  ohm::OccupancyMap src(0.1, glm::u8vec3(16), ohm::MapFlag::kVoxelMean);
+
+  const glm::dvec3 shared(0.05);
+  const glm::dvec3 dst_only(1.05, 0.05, 0.05);
+  const glm::dvec3 src_only(-2.05, 0.05, 0.05);
+
+  ohm::integrateHit(dst, dst.voxelKey(shared));
+  ohm::integrateHit(dst, dst.voxelKey(dst_only));
+  ohm::integrateHit(src, src.voxelKey(shared));
+  ohm::integrateMiss(src, src.voxelKey(shared));
+  ohm::integrateHit(src, src.voxelKey(src_only));
+
+  const float expected_shared = occupancy(dst, shared) + occupancy(src, shared);
+  ASSERT_TRUE(ohm::mergeMap(dst, src));
+
+  EXPECT_FLOAT_EQ(occupancy(dst, shared), expected_shared);
+  EXPECT_FLOAT_EQ(occupancy(dst, dst_only), dst.hitValue());
+  EXPECT_FLOAT_EQ(occupancy(dst, src_only), src.hitValue());
+
+  // Values are clamped.
+  for (int i = 0; i < 100; ++i)
+  {
+    ohm::integrateHit(src, src.voxelKey(shared));
+  }
+  ASSERT_TRUE(ohm::mergeMap(dst, src));
+  EXPECT_FLOAT_EQ(occupancy(dst, shared), dst.maxVoxelValue());
+
+  // Resolution must match.
+  ohm::OccupancyMap other(0.2, glm::u8vec3(16));
+  EXPECT_FALSE(ohm::canMerge(other, src));
+  EXPECT_FALSE(ohm::mergeMap(other, src));
+  EXPECT_FALSE(ohm::mergeMap(dst, dst));
+}
+
+
+TEST(MapMerge, MeanCovariance)
+{
+  ohm::OccupancyMap dst(0.1, glm::u8vec3(16), ohm::MapFlag::kVoxelMean);
+  dst.addLayer(ohm::default_layer::covarianceLayerName(), [](ohm::MapLayout &layout) { ohm::addCovariance(layout); });
+  std::unique_ptr<ohm::OccupancyMap> src(dst.clone());
+
+  const ohm::Key key = dst.voxelKey(glm::dvec3(0.05));
+  const glm::dvec3 centre = dst.voxelCentreGlobal(key);
+  const unsigned dst_count = 4;
+  const unsigned src_count = 12;
+
+  const auto init_voxel = [&key](ohm::OccupancyMap &map, const glm::dvec3 &pos, unsigned count, float scale) {
+    ohm::integrateHit(map, key);
+    ohm::Voxel<ohm::VoxelMean> mean(&map, map.layout().meanLayer(), key);
+    ohm::setPositionSafe(mean, pos, count);
+    ohm::Voxel<ohm::CovarianceVoxel> cov(&map, map.layout().covarianceLayer(), key);
+    ohm::CovarianceVoxel cov_data{};
+    cov_data.trianglar_covariance[0] = cov_data.trianglar_covariance[2] = cov_data.trianglar_covariance[5] = scale;
+    cov.write(cov_data);
+    return ohm::positionUnsafe(mean);
+  };
+
+  const glm::dvec3 dst_pos = init_voxel(dst, centre + glm::dvec3(0.02, 0, 0), dst_count, 0.01f);
+  const glm::dvec3 src_pos = init_voxel(*src, centre - glm::dvec3(0.02, 0.01, 0), src_count, 0.02f);
+
+  ASSERT_TRUE(ohm::mergeMap(dst, *src));
+
+  const double count = dst_count + src_count;
+  const glm::dvec3 expected_pos = (dst_pos * double(dst_count) + src_pos * double(src_count)) / count;
+  const glm::dvec3 separation = src_pos - dst_pos;
+  const glm::dmat3 expected_cov =
+    (double(dst_count) * glm::dmat3(0.01 * 0.01) + double(src_count) * glm::dmat3(0.02 * 0.02)) / count +
+    (dst_count * src_count / (count * count)) * glm::outerProduct(separation, separation);
+
+  ohm::Voxel<const ohm::VoxelMean> mean(&dst, dst.layout().meanLayer(), key);
+  ASSERT_TRUE(mean.isValid());
+  EXPECT_EQ(mean.data().count, dst_count + src_count);
+  const glm::dvec3 merged_pos = ohm::positionUnsafe(mean);
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_NEAR(merged_pos[i], expected_pos[i], dst.resolution() / 1000.0);
+  }
+
+  ohm::Voxel<const ohm::CovarianceVoxel> cov(&dst, dst.layout().covarianceLayer(), key);
+  ASSERT_TRUE(cov.isValid());
+  const ohm::CovarianceVoxel cov_data = cov.data();
+  const glm::dmat3 merged_cov = ohm::covarianceMatrix(&cov_data);
+  for (int c = 0; c < 3; ++c)
+  {
+    for (int r = 0; r < 3; ++r)
+    {
+      EXPECT_NEAR(merged_cov[c][r], expected_cov[c][r], 1e-7);
+    }
+  }
+}
+
+
+TEST(MapMerge, Transform)
+{
+  ohm::OccupancyMap dst(0.1, glm::u8vec3(16));
+  ohm::OccupancyMap src(0.1, glm::u8vec3(16));
+
+  const glm::dvec3 point(0.35, -0.25, 0.05);
+  ohm::integrateHit(src, src.voxelKey(point));
+
+  // Translate by a whole number of voxels.
+  const glm::dvec3 translation(2.0, 1.0, -0.5);
+  ASSERT_TRUE(ohm::mergeMap(dst, src, glm::translate(glm::dmat4(1.0), translation)));
+  EXPECT_FLOAT_EQ(occupancy(dst, point + translation), src.hitValue());
+  EXPECT_EQ(occupancy(dst, point), ohm::unobservedOccupancyValue());
+
+  // Rotate 90 degrees about z.
+  ohm::OccupancyMap rotated(0.1, glm::u8vec3(16));
+  ASSERT_TRUE(ohm::mergeMap(rotated, src, glm::rotate(glm::dmat4(1.0), 0.5 * M_PI, glm::dvec3(0, 0, 1))));
+  EXPECT_FLOAT_EQ(occupancy(rotated, glm::dvec3(-point.y, point.x, point.z)), src.hitValue());
+}
+
+
+TEST(MapMerge, Files)
+{
+  ohm::OccupancyMap map_a(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohm::OccupancyMap map_b(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohmgen::boxRoom(map_a, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ohmgen::boxRoom(map_b, glm::dvec3(-1.5), glm::dvec3(4.5));
+
+  const std::vector<std::string> inputs = { "test-merge-a.ohm", "test-merge-b.ohm" };
+  const char *output = "test-merge-out.ohm";
+  ASSERT_EQ(ohm::save(inputs[0], map_a), ohm::kSeOk);
+  ASSERT_EQ(ohm::save(inputs[1], map_b), ohm::kSeOk);
+  ASSERT_EQ(ohm::mergeMapFiles(output, inputs), ohm::kSeOk);
+
+  std::unique_ptr<ohm::OccupancyMap> expected(map_a.clone());
+  ASSERT_TRUE(ohm::mergeMap(*expected, map_b));
+
+  ohm::OccupancyMap merged(1.0);
+  ASSERT_EQ(ohm::load(output, merged), ohm::kSeOk);
+  ohmtestutil::compareMaps(merged, *expected, ohmtestutil::kCfCompareExtended);
+
+  ohm::OccupancyMap other(0.5, glm::u8vec3(8));
+  ASSERT_EQ(ohm::save("test-merge-c.ohm", other), ohm::kSeOk);
+  EXPECT_EQ(ohm::mergeMapFiles(output, { inputs[0], "test-merge-c.ohm" }), ohm::kSeMergeMismatch);
+  EXPECT_EQ(ohm::mergeMapFiles(output, {}), ohm::kSeMergeMismatch);
+}
+}  // namespace mapmergetests
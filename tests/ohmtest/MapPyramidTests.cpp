@@ -0,0 +1,164 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapPyramid.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mappyramidtests
+{
+/// Validate each voxel of @p coarse against the max of the eight covered voxels in @p child .
+void validateMaxPooling(const ohm::OccupancyMap &coarse, const ohm::OccupancyMap &child)
+{
+  ohm::Voxel<const float> child_occupancy(&child, child.layout().occupancyLayer());
+  size_t observed_count = 0;
+  for (auto iter = coarse.begin(); iter != coarse.end(); ++iter)
+  {
+    ohm::Voxel<const float> occupancy(&coarse, coarse.layout().occupancyLayer(), *iter);
+    ASSERT_TRUE(occupancy.isValid());
+
+    float expected = ohm::unobservedOccupancyValue();
+    const glm::dvec3 centre = coarse.voxelCentreGlobal(*iter);
+    const double offset = 0.5 * child.resolution();
+    for (int i = 0; i < 8; ++i)
+    {
+      const glm::dvec3 corner(offset * ((i & 1) ? 1 : -1), offset * ((i & 2) ? 1 : -1), offset * ((i & 4) ? 1 : -1));
+      child_occupancy.setKey(child.voxelKey(centre + corner));
+      if (child_occupancy.isValid() && child_occupancy.data() != ohm::unobservedOccupancyValue())
+      {
+        expected = (expected == ohm::unobservedOccupancyValue()) ? child_occupancy.data() :
+                                                                   std::max(expected, child_occupancy.data());
+      }
+    }
+
+    EXPECT_EQ(occupancy.data(), expected);
+    observed_count += (expected != ohm::unobservedOccupancyValue());
+  }
+  EXPECT_GT(observed_count, 0u);
+}
+
+
+TEST(MapPyramid, MaxPooling)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 4.0, 2000u, 0x1234u);
+
+  ohm::MapPyramid pyramid(3, ohm::PyramidPooling::kMax);
+  EXPECT_EQ(pyramid.level(1), nullptr);
+  EXPECT_EQ(pyramid.update(map, 0), ohm::kMprUpToDate);
+  EXPECT_EQ(pyramid.pendingCount(), 0u);
+
+  const ohm::OccupancyMap *child = &map;
+  for (unsigned level = 1; level <= pyramid.levelCount(); ++level)
+  {
+    const ohm::OccupancyMap *coarse = pyramid.level(level);
+    ASSERT_NE(coarse, nullptr);
+    EXPECT_DOUBLE_EQ(coarse->resolution(), child->resolution() * 2.0);
+    validateMaxPooling(*coarse, *child);
+    child = coarse;
+  }
+
+  EXPECT_EQ(pyramid.level(0), nullptr);
+  EXPECT_EQ(pyramid.level(pyramid.levelCount() + 1), nullptr);
+  EXPECT_EQ(pyramid.levelForResolution(0.1), 0u);
+  EXPECT_EQ(pyramid.levelForResolution(0.2), 1u);
+  EXPECT_EQ(pyramid.levelForResolution(0.5), 2u);
+  EXPECT_EQ(pyramid.levelForResolution(10.0), 3u);
+}
+
+
+TEST(MapPyramid, Incremental)
+{
+  // An incrementally updated pyramid must match one built from scratch.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  ohm::MapPyramid pyramid(2, ohm::PyramidPooling::kMean);
+
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 3.0, 2000u, 0x10u);
+  pyramid.update(map, 0);
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(4.0, 0.0, 0.0), 3.0, 2000u, 0x20u);
+  pyramid.update(map, 0);
+
+  ohm::MapPyramid rebuilt(2, ohm::PyramidPooling::kMean);
+  rebuilt.update(map, 0);
+
+  for (unsigned level = 1; level <= pyramid.levelCount(); ++level)
+  {
+    const ohm::OccupancyMap &incremental_map = *pyramid.level(level);
+    const ohm::OccupancyMap &rebuilt_map = *rebuilt.level(level);
+    ohm::Voxel<const float> incremental(&incremental_map, incremental_map.layout().occupancyLayer());
+    size_t observed_count = 0;
+    for (auto iter = rebuilt_map.begin(); iter != rebuilt_map.end(); ++iter)
+    {
+      ohm::Voxel<const float> expected(&rebuilt_map, rebuilt_map.layout().occupancyLayer(), *iter);
+      if (expected.data() == ohm::unobservedOccupancyValue())
+      {
+        continue;
+      }
+      incremental.setKey(*iter);
+      ASSERT_TRUE(incremental.isValid());
+      EXPECT_EQ(incremental.data(), expected.data());
+      ++observed_count;
+    }
+    EXPECT_GT(observed_count, 0u);
+  }
+
+  // No further changes: nothing to do.
+  EXPECT_EQ(pyramid.update(map, 0), ohm::kMprUpToDate);
+  EXPECT_EQ(pyramid.pendingCount(), 0u);
+}
+
+
+TEST(MapPyramid, Rebase)
+{
+  // Validate the pyramid tracks a source map rebase, including regions pending at the time of the rebase. Rebasing
+  // by one region keeps the voxel alignment of the first four levels, but not the fifth, which must be rebuilt.
+  for (unsigned level_count : { 3u, 5u })
+  {
+    ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+    ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 4.0, 2000u, 0x1234u);
+
+    ohm::MapPyramid pyramid(level_count, ohm::PyramidPooling::kMax);
+    pyramid.update(map, 1e-9);
+    const ohm::OccupancyMap *level_one = pyramid.level(1);
+    ASSERT_NE(level_one, nullptr);
+
+    ASSERT_TRUE(map.rebaseOrigin(map.regionCentreGlobal(glm::i16vec3(1, 0, 0))));
+    ohmtestutil::integrateRandomRays(map, glm::dvec3(1.0, 0.0, 0.0), 4.0, 500u, 0x4321u);
+    EXPECT_EQ(pyramid.update(map, 0), ohm::kMprUpToDate);
+    EXPECT_EQ(pyramid.pendingCount(), 0u);
+    if (level_count < 5)
+    {
+      EXPECT_EQ(pyramid.level(1), level_one);
+    }
+
+    const ohm::OccupancyMap *child = &map;
+    for (unsigned level = 1; level <= pyramid.levelCount(); ++level)
+    {
+      const ohm::OccupancyMap *coarse = pyramid.level(level);
+      ASSERT_NE(coarse, nullptr);
+      validateMaxPooling(*coarse, *child);
+      child = coarse;
+    }
+  }
+}
+
+
+TEST(MapPyramid, OddRegionDimensions)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(15));
+  ohm::MapPyramid pyramid;
+  EXPECT_THROW(pyramid.update(map, 0), std::runtime_error);
+}
+}  // namespace mappyramidtests
@@ -0,0 +1,208 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/Key.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapSharedMemory.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelBlock.h>
+#include <ohm/VoxelBuffer.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmtools/OhmGen.h>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+namespace mapsharedmemorytests
+{
+const char *const kSegmentName = "ohm_test_shared_map";
+
+/// Validate the published layers of every region in @p map against @p reader .
+void validate(const ohm::OccupancyMap &map, const ohm::MapSharedReader &reader)
+{
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  EXPECT_EQ(reader.regionCount(), chunks.size());
+
+  std::vector<glm::i16vec3> region_keys;
+  EXPECT_EQ(reader.regionKeys(region_keys), chunks.size());
+
+  const int occupancy_layer = reader.layerIndex(ohm::default_layer::occupancyLayerName());
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  std::vector<uint8_t> buffer;
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    EXPECT_TRUE(reader.hasRegion(chunk->region.coord));
+    for (unsigned i = 0; i < reader.layerCount(); ++i)
+    {
+      const int layer_index = map.layout().layerIndex(reader.layerName(i));
+      ASSERT_GE(layer_index, 0);
+      uint64_t stamp = 0;
+      ASSERT_TRUE(reader.readRegion(chunk->region.coord, i, buffer, &stamp));
+      // The region stamp covers all published layers.
+      EXPECT_GE(stamp, chunk->layerTouchedStamp(unsigned(layer_index)));
+      ohm::VoxelBuffer<const ohm::VoxelBlock> voxels(chunk->voxel_blocks[layer_index]);
+      ASSERT_EQ(buffer.size(), voxels.voxelMemorySize());
+      EXPECT_EQ(std::memcmp(buffer.data(), voxels.voxelMemory(), buffer.size()), 0);
+    }
+
+    // Spot check voxel reads.
+    for (uint8_t v = 0; v < map.regionVoxelDimensions().x; ++v)
+    {
+      const ohm::Key key(chunk->region.coord, glm::u8vec3(v, v / 2, v / 3));
+      occupancy.setKey(key);
+      float expected = 0;
+      float value = 1;
+      occupancy.read(&expected);
+      ASSERT_TRUE(reader.readVoxel(key, occupancy_layer, &value));
+      EXPECT_EQ(value, expected);
+    }
+  }
+}
+
+
+TEST(MapSharedMemory, Publish)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean);
+  ohmgen::boxRoom(map, glm::dvec3(-2.5), glm::dvec3(2.5));
+
+  ohm::MapSharedPublisher publisher;
+  EXPECT_FALSE(publisher.create(kSegmentName, map, { "no_such_layer" }, 1024));
+  ASSERT_TRUE(publisher.create(kSegmentName, map,
+                               { ohm::default_layer::occupancyLayerName(), ohm::default_layer::meanLayerName() },
+                               1000));
+  EXPECT_EQ(publisher.regionCapacity(), 1024u);
+
+  // Nothing to read before the first publish.
+  ohm::MapSharedReader reader;
+  ASSERT_TRUE(reader.open(kSegmentName));
+  EXPECT_EQ(reader.epoch(), 0u);
+  EXPECT_EQ(reader.regionCount(), 0u);
+  EXPECT_FALSE(reader.hasRegion(glm::i16vec3(0)));
+
+  EXPECT_EQ(publisher.publish(map), map.regionCount());
+  EXPECT_EQ(publisher.droppedRegionCount(), 0u);
+  EXPECT_EQ(reader.epoch(), 1u);
+  EXPECT_EQ(reader.mapStamp(), map.stamp());
+
+  // Validate the map configuration.
+  EXPECT_EQ(reader.resolution(), map.resolution());
+  EXPECT_EQ(reader.origin(), map.origin());
+  EXPECT_EQ(reader.regionVoxelDimensions(), map.regionVoxelDimensions());
+  ASSERT_EQ(reader.layerCount(), 2u);
+  EXPECT_EQ(reader.layerIndex(ohm::default_layer::meanLayerName()), 1);
+  EXPECT_EQ(reader.layerIndex("no_such_layer"), -1);
+  EXPECT_EQ(reader.voxelByteSize(0), sizeof(float));
+  EXPECT_EQ(reader.voxelKey(glm::dvec3(1.1, -0.3, 2.2)), map.voxelKey(glm::dvec3(1.1, -0.3, 2.2)));
+
+  validate(map, reader);
+
+  // Unchanged regions are not published again.
+  EXPECT_EQ(publisher.publish(map), 0u);
+  EXPECT_EQ(reader.epoch(), 2u);
+
+  // Change a few regions.
+  const std::vector<glm::dvec3> rays = { glm::dvec3(0.1), glm::dvec3(1.1, 0.2, 0.3) };
+  ohm::RayMapperOccupancy mapper(&map);
+  mapper.integrateRays(rays.data(), rays.size());
+  const size_t changed = publisher.publish(map);
+  EXPECT_GT(changed, 0u);
+  EXPECT_LT(changed, map.regionCount());
+  validate(map, reader);
+
+  // Remove regions.
+  std::vector<glm::i16vec3> before;
+  reader.regionKeys(before);
+  map.cullRegionsOutside(glm::dvec3(0.0), glm::dvec3(3.0));
+  EXPECT_EQ(publisher.publish(map), before.size() - map.regionCount());
+  validate(map, reader);
+
+  // Readers keep their mapping after the publisher closes, but the segment can no longer be opened.
+  publisher.close();
+  EXPECT_TRUE(reader.isOpen());
+  EXPECT_EQ(reader.regionCount(), map.regionCount());
+#ifndef _WIN32
+  ohm::MapSharedReader late_reader;
+  EXPECT_FALSE(late_reader.open(kSegmentName));
+#endif  // _WIN32
+}
+
+
+TEST(MapSharedMemory, VoxelOrder)
+{
+  // Voxel reads must follow the layer voxel order of the source map.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8), ohm::MapFlag::kVoxelMean | ohm::MapFlag::kVoxelOrderMorton);
+  ASSERT_EQ(map.layerVoxelOrder(map.layout().occupancyLayer()), ohm::VoxelOrder::kMorton);
+  ohmgen::boxRoom(map, glm::dvec3(-2.5), glm::dvec3(2.5));
+
+  ohm::MapSharedPublisher publisher;
+  ASSERT_TRUE(publisher.create(kSegmentName, map,
+                               { ohm::default_layer::occupancyLayerName(), ohm::default_layer::meanLayerName() },
+                               1024));
+  EXPECT_EQ(publisher.publish(map), map.regionCount());
+
+  ohm::MapSharedReader reader;
+  ASSERT_TRUE(reader.open(kSegmentName));
+  EXPECT_EQ(reader.layerVoxelOrder(0), ohm::VoxelOrder::kMorton);
+  EXPECT_EQ(reader.layerVoxelOrder(1), map.layerVoxelOrder(map.layout().meanLayer()));
+  validate(map, reader);
+
+  // Check every voxel as the spot checks in validate() may coincide with row major indices.
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  glm::u8vec3 local_key(0);
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    for (local_key.z = 0; local_key.z < map.regionVoxelDimensions().z; ++local_key.z)
+    {
+      for (local_key.y = 0; local_key.y < map.regionVoxelDimensions().y; ++local_key.y)
+      {
+        for (local_key.x = 0; local_key.x < map.regionVoxelDimensions().x; ++local_key.x)
+        {
+          const ohm::Key key(chunk->region.coord, local_key);
+          occupancy.setKey(key);
+          float expected = 0;
+          float value = 1;
+          occupancy.read(&expected);
+          ASSERT_TRUE(reader.readVoxel(key, 0, &value));
+          EXPECT_EQ(value, expected);
+        }
+      }
+    }
+  }
+}
+
+
+TEST(MapSharedMemory, Capacity)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmgen::boxRoom(map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_GT(map.regionCount(), 4u);
+
+  ohm::MapSharedPublisher publisher;
+  ASSERT_TRUE(publisher.create(kSegmentName, map, { ohm::default_layer::occupancyLayerName() }, 4));
+  EXPECT_EQ(publisher.publish(map), 4u);
+  EXPECT_EQ(publisher.regionCount(), 4u);
+  EXPECT_EQ(publisher.droppedRegionCount(), map.regionCount() - 4u);
+
+  ohm::MapSharedReader reader;
+  ASSERT_TRUE(reader.open(kSegmentName));
+  std::vector<glm::i16vec3> region_keys;
+  EXPECT_EQ(reader.regionKeys(region_keys), 4u);
+  for (const glm::i16vec3 &region_key : region_keys)
+  {
+    EXPECT_NE(map.region(region_key), nullptr);
+  }
+}
+}  // namespace mapsharedmemorytests
@@ -0,0 +1,125 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapSnapshot.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <memory>
+
+namespace mapsnapshottests
+{
+/// Validate the occupancy values of @p snapshot match @p map .
+void compareOccupancy(const ohm::MapSnapshot &snapshot, const ohm::OccupancyMap &map)
+{
+  EXPECT_EQ(snapshot.regionCount(), map.regionCount());
+  const int occupancy_layer = map.layout().occupancyLayer();
+  ohm::Voxel<const float> occupancy(&map, occupancy_layer);
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(iter);
+    float snapshot_value = 0;
+    ASSERT_TRUE(snapshot.read(*iter, occupancy_layer, &snapshot_value));
+    EXPECT_EQ(snapshot_value, occupancy.data());
+  }
+}
+
+
+TEST(MapSnapshot, Publish)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohm::MapSnapshotPublisher publisher(map);
+  EXPECT_EQ(publisher.latest(), nullptr);
+
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 500u, 0x1234u);
+  const std::shared_ptr<const ohm::MapSnapshot> first = publisher.publish();
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(publisher.latest(), first);
+  EXPECT_EQ(first->epoch(), 1u);
+  EXPECT_EQ(first->stamp(), map.stamp());
+  EXPECT_EQ(publisher.lastCopiedLayerCount(), map.regionCount() * map.layout().layerCount());
+  compareOccupancy(*first, map);
+
+  // Keep a deep copy to validate the first snapshot is unaffected by further updates.
+  std::unique_ptr<ohm::OccupancyMap> reference(map.clone());
+
+  // Update a small part of the map. Only the changed layers should be copied.
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(1.0), 0.5, 500u, 0x4321u);
+  const std::shared_ptr<const ohm::MapSnapshot> second = publisher.publish();
+  EXPECT_EQ(second->epoch(), 2u);
+  EXPECT_GT(publisher.lastCopiedLayerCount(), 0u);
+  EXPECT_LT(publisher.lastCopiedLayerCount(), map.regionCount() * map.layout().layerCount());
+  compareOccupancy(*second, map);
+  compareOccupancy(*first, *reference);
+
+  // Unchanged regions are shared between snapshots.
+  size_t shared_count = 0;
+  for (const auto &entry : second->regions())
+  {
+    const ohm::MapSnapshot::Region *previous = first->region(entry.first);
+    shared_count += (previous == entry.second.get()) ? 1 : 0;
+  }
+  EXPECT_GT(shared_count, 0u);
+
+  // Nothing changed: nothing copied.
+  publisher.publish();
+  EXPECT_EQ(publisher.lastCopiedLayerCount(), 0u);
+
+  // Removed regions are dropped.
+  map.clear();
+  EXPECT_EQ(publisher.publish()->regionCount(), 0u);
+  // Earlier snapshots retain their data.
+  float value = 0;
+  EXPECT_GT(second->regionCount(), 0u);
+  EXPECT_TRUE(second->read(reference->voxelKey(glm::dvec3(0.0)), second->layout().occupancyLayer(), &value));
+}
+
+
+TEST(MapSnapshot, Rebase)
+{
+  // Validate a map rebase re-keys the published regions while still sharing the unchanged layer data.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohm::MapSnapshotPublisher publisher(map);
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 500u, 0x1234u);
+  const std::shared_ptr<const ohm::MapSnapshot> first = publisher.publish();
+  EXPECT_EQ(first->rebaseOffset(), glm::dvec3(0));
+  EXPECT_EQ(first->origin(), map.origin());
+
+  const glm::i16vec3 rebase_key(2, 1, 0);
+  ASSERT_TRUE(map.rebaseOrigin(map.regionCentreGlobal(rebase_key)));
+  const std::shared_ptr<const ohm::MapSnapshot> second = publisher.publish();
+  EXPECT_EQ(second->rebaseOffset(), glm::dvec3(rebase_key));
+  EXPECT_EQ(second->origin(), map.origin());
+  EXPECT_EQ(publisher.lastCopiedLayerCount(), 0u);
+  compareOccupancy(*second, map);
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  for (const auto &entry : first->regions())
+  {
+    const ohm::MapSnapshot::Region *rebased = second->region(glm::i16vec3(entry.first - rebase_key));
+    ASSERT_NE(rebased, nullptr);
+    EXPECT_EQ(rebased->coord, glm::i16vec3(entry.first - rebase_key));
+    EXPECT_EQ(rebased->layers[occupancy_layer], entry.second->layers[occupancy_layer]);
+  }
+
+  // The first snapshot retains the original keys.
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    ohm::Key original_key = *iter;
+    original_key.setRegionKey(glm::i16vec3(iter->regionKey() + rebase_key));
+    float first_value = 0;
+    float second_value = 0;
+    ASSERT_TRUE(first->read(original_key, occupancy_layer, &first_value));
+    ASSERT_TRUE(second->read(*iter, occupancy_layer, &second_value));
+    EXPECT_EQ(first_value, second_value);
+  }
+}
+}  // namespace mapsnapshottests
@@ -6,11 +6,35 @@
 #include "OhmTestConfig.h"
 
 #include <ohm/Aabb.h>
+#include <ohm/CopyUtil.h>
+#include <ohm/DefaultLayer.h>
+#include <ohm/HugePageAllocator.h>
 #include <ohm/Key.h>
+#include <ohm/KeyList.h>
 #include <ohm/LineQuery.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapMemoryAccounting.h>
+#include <ohm/LineWalk.h>
+#include <ohm/MapLayer.h>
+#include <ohm/MapSerialise.h>
+#include <ohm/MemoryTrack.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/OccupancyType.h>
+#include <ohm/ParallelForEach.h>
+#include <ohm/RayBatch.h>
+#include <ohm/RayFilter.h>
 #include <ohm/RayMapperOccupancy.h>
+#include <ohm/RegionIndexer.h>
+#include <ohm/RegionPreallocator.h>
+#include <ohm/RegionStatistics.h>
+#include <ohm/TaskArena.h>
+#include <ohm/VoxelBlock.h>
+#include <ohm/VoxelBuffer.h>
 #include <ohm/VoxelData.h>
+#include <ohm/VoxelMean.h>
+#include <ohm/VoxelMemoryPool.h>
+#include <ohm/VoxelOrder.h>
 
 #include <ohmtools/OhmCloud.h>
 #include <ohmtools/OhmGen.h>
@@ -19,10 +43,15 @@
 
 #include <ohmutil/Profile.h>
 
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <random>
+#include <thread>
 
 #include <gtest/gtest.h>
 #include "ohmtestcommon/OhmTestUtil.h"
@@ -194,4 +223,1286 @@ TEST(Map, ClipBox)
 
   EXPECT_TRUE(touched);
 }
+
+
+TEST(Map, RayBatchFilter)
+{
+  // Validate the batch filters against the per ray filters, including bad rays.
+  std::mt19937 rand_engine(0x1234);
+  std::uniform_real_distribution<double> rand(-20.0, 20.0);
+  std::vector<glm::dvec3> rays;
+  for (unsigned i = 0; i < 1000; ++i)
+  {
+    rays.emplace_back(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+    rays.emplace_back(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+  }
+  rays[3].x = std::numeric_limits<double>::quiet_NaN();
+  rays[6].y = std::numeric_limits<double>::infinity();
+  rays[9].z = -std::numeric_limits<double>::infinity();
+
+  const double max_range = 15.0;
+  const Aabb clip_box(glm::dvec3(-5.0), glm::dvec3(5.0));
+  const auto good_ray = [max_range](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
+    return goodRayFilter(start, end, filter_flags, max_range);
+  };
+  const auto good_ray_batch = [max_range](glm::dvec3 *batch_rays, unsigned *filter_flags, size_t ray_count) {
+    goodRayBatchFilter(batch_rays, filter_flags, ray_count, max_range);
+  };
+  const auto clip_ray = [max_range](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
+    return clipRayFilter(start, end, filter_flags, max_range);
+  };
+  const auto clip_ray_batch = [max_range](glm::dvec3 *batch_rays, unsigned *filter_flags, size_t ray_count) {
+    clipRayBatchFilter(batch_rays, filter_flags, ray_count, max_range);
+  };
+  const auto clip_bounded = [&clip_box](glm::dvec3 *start, glm::dvec3 *end, unsigned *filter_flags) {
+    return clipBounded(start, end, filter_flags, clip_box);
+  };
+  const auto clip_bounded_batch = [&clip_box](glm::dvec3 *batch_rays, unsigned *filter_flags, size_t ray_count) {
+    clipBoundedBatch(batch_rays, filter_flags, ray_count, clip_box);
+  };
+  const std::vector<std::pair<RayFilterFunction, RayBatchFilterFunction>> filters = {
+    { good_ray, good_ray_batch },
+    { clip_ray, clip_ray_batch },
+    { clip_bounded, clip_bounded_batch },
+  };
+
+
+  const size_t ray_count = rays.size() / 2;
+  for (const auto &filter : filters)
+  {
+    std::vector<glm::dvec3> ray_filtered = rays;
+    std::vector<unsigned> ray_flags(ray_count);
+    std::vector<glm::dvec3> batch_filtered = rays;
+    std::vector<unsigned> batch_flags(ray_count);
+
+    // Per ray filter via the filterRays() fallback.
+    const size_t ray_culled = filterRays(ray_filtered.data(), ray_flags.data(), ray_count, nullptr, filter.first);
+    const size_t batch_culled =
+      filterRays(batch_filtered.data(), batch_flags.data(), ray_count, filter.second, filter.first);
+    EXPECT_EQ(ray_culled, batch_culled);
+    EXPECT_GT(ray_culled, 0u);
+
+    for (size_t i = 0; i < ray_count; ++i)
+    {
+      ASSERT_EQ(ray_flags[i], batch_flags[i]) << "ray " << i;
+      if (!(ray_flags[i] & kRffInvalid))
+      {
+        EXPECT_NEAR(glm::length(ray_filtered[i * 2 + 0] - batch_filtered[i * 2 + 0]), 0.0, 1e-9);
+        EXPECT_NEAR(glm::length(ray_filtered[i * 2 + 1] - batch_filtered[i * 2 + 1]), 0.0, 1e-9);
+      }
+    }
+  }
+
+  // Setting a per ray filter must clear the default batch filter so the new filter is honoured.
+  OccupancyMap map(0.25);
+  EXPECT_TRUE(bool(map.rayBatchFilter()));
+  map.setRayFilter(filters[2].first);
+  EXPECT_FALSE(bool(map.rayBatchFilter()));
+  map.setRayBatchFilter(filters[2].second);
+  EXPECT_TRUE(bool(map.rayBatchFilter()));
+  map.clearRayFilter();
+  EXPECT_FALSE(bool(map.rayFilter()));
+  EXPECT_FALSE(bool(map.rayBatchFilter()));
+}
+
+
+TEST(Map, RayBatchNullSample)
+{
+  // A sample beyond the representable key range must not generate an update for a null key.
+  OccupancyMap map(0.1);
+  RayBatch batch;
+  batch.addRay(glm::dvec3(0.0), glm::dvec3(1e7, 0.0, 0.0), 0, 0, kRbSample);
+  batch.addRay(glm::dvec3(0.0), glm::dvec3(1.0, 0.0, 0.0), 1, 0, kRbSample);
+  batch.build(map);
+
+  ASSERT_EQ(batch.voxels().size(), 1u);
+  EXPECT_EQ(batch.voxels().front().ray_index, 1u);
+  EXPECT_EQ(batch.voxels().front().key, map.voxelKey(glm::dvec3(1.0, 0.0, 0.0)));
+  ASSERT_EQ(batch.regions().size(), 1u);
+  EXPECT_EQ(map.regionCount(), 1u);
+}
+
+
+TEST(Map, ThreadedIntegration)
+{
+  // Validate the threaded RayMapperOccupancy update generates exactly the same map as the single threaded update.
+  const double resolution = 0.25;
+  const glm::u8vec3 region_size(16);
+  OccupancyMap map(resolution, region_size);
+  OccupancyMap threaded_map(resolution, region_size);
+
+  for (OccupancyMap *target : { &map, &threaded_map })
+  {
+    MapLayout layout = target->layout();
+    addVoxelMean(layout);
+    addTraversal(layout);
+    addTouchTime(layout);
+    addIncidentNormal(layout);
+    target->updateLayout(layout);
+  }
+
+  // Generate rays from a number of origins such that rays cross region boundaries and overlap one another.
+  std::mt19937 rand_engine(0x1234u);
+  std::uniform_real_distribution<double> rand(-8.0, 8.0);
+  std::vector<glm::dvec3> rays;
+  std::vector<double> timestamps;
+  const size_t ray_count = 20000u;
+  glm::dvec3 origin(0.0);
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    if (i % 1000 == 0)
+    {
+      origin = glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)) * 0.25;
+    }
+    rays.emplace_back(origin);
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+    timestamps.emplace_back(0.01 * double(i));
+  }
+
+  RayMapperOccupancy mapper(&map);
+  RayMapperOccupancy threaded_mapper(&threaded_map);
+  threaded_mapper.setUseThreads(true);
+#ifdef OHM_FEATURE_THREADS
+  EXPECT_TRUE(threaded_mapper.useThreads());
+#else   // OHM_FEATURE_THREADS
+  EXPECT_FALSE(threaded_mapper.useThreads());
+#endif  // OHM_FEATURE_THREADS
+
+  // Integrate in batches to validate carrying state between calls.
+  const size_t batch_size = 2000u;
+  for (size_t i = 0; i < ray_count; i += batch_size)
+  {
+    mapper.integrateRays(rays.data() + i * 2, batch_size * 2, nullptr, timestamps.data() + i, kRfDefault);
+    threaded_mapper.integrateRays(rays.data() + i * 2, batch_size * 2, nullptr, timestamps.data() + i, kRfDefault);
+  }
+
+  ASSERT_EQ(map.regionCount(), threaded_map.regionCount());
+
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  for (const MapChunk *chunk : chunks)
+  {
+    const MapChunk *threaded_chunk = threaded_map.region(chunk->region.coord);
+    ASSERT_NE(threaded_chunk, nullptr);
+    EXPECT_EQ(chunk->first_valid_index, threaded_chunk->first_valid_index);
+    for (size_t layer_index = 0; layer_index < map.layout().layerCount(); ++layer_index)
+    {
+      VoxelBuffer<const VoxelBlock> buffer(chunk->voxel_blocks[layer_index]);
+      VoxelBuffer<const VoxelBlock> threaded_buffer(threaded_chunk->voxel_blocks[layer_index]);
+      ASSERT_EQ(buffer.voxelMemorySize(), threaded_buffer.voxelMemorySize());
+      EXPECT_EQ(memcmp(buffer.voxelMemory(), threaded_buffer.voxelMemory(), buffer.voxelMemorySize()), 0)
+        << map.layout().layer(layer_index).name();
+    }
+  }
+}
+
+
+TEST(Map, AggregateSamples)
+{
+  // Validate kRfAggregateSamples against the per sample update. With kRfExcludeRay there are no miss updates to
+  // reorder, so occupancy and sample counts must match exactly, while the voxel mean is quantised fewer times.
+  const double resolution = 0.25;
+  OccupancyMap map(resolution, glm::u8vec3(16), MapFlag::kVoxelMean);
+  OccupancyMap aggregate_map(resolution, glm::u8vec3(16), MapFlag::kVoxelMean);
+
+  // Dense samples in a small volume so many samples share a voxel.
+  std::mt19937 rand_engine(0x5678u);
+  std::uniform_real_distribution<double> rand(-1.0, 1.0);
+  std::vector<glm::dvec3> rays;
+  const size_t ray_count = 10000u;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(glm::dvec3(0.0, 0.0, 5.0));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  RayMapperOccupancy(&map).integrateRays(rays.data(), rays.size(), nullptr, nullptr, kRfExcludeRay);
+  RayMapperOccupancy(&aggregate_map)
+    .integrateRays(rays.data(), rays.size(), nullptr, nullptr, kRfExcludeRay | kRfAggregateSamples);
+
+  Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  Voxel<const VoxelMean> mean(&map, map.layout().meanLayer());
+  Voxel<const float> aggregate_occupancy(&aggregate_map, aggregate_map.layout().occupancyLayer());
+  Voxel<const VoxelMean> aggregate_mean(&aggregate_map, aggregate_map.layout().meanLayer());
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    const Key key = map.voxelKey(rays[i]);
+    setVoxelKey(key, occupancy, mean, aggregate_occupancy, aggregate_mean);
+    ASSERT_TRUE(occupancy.isValid());
+    ASSERT_TRUE(aggregate_occupancy.isValid());
+    EXPECT_EQ(occupancy.data(), aggregate_occupancy.data());
+    EXPECT_EQ(mean.data().count, aggregate_mean.data().count);
+    const glm::dvec3 pos = positionUnsafe(mean);
+    const glm::dvec3 aggregate_pos = positionUnsafe(aggregate_mean);
+    EXPECT_NEAR(pos.x, aggregate_pos.x, resolution / 100.0);
+    EXPECT_NEAR(pos.y, aggregate_pos.y, resolution / 100.0);
+    EXPECT_NEAR(pos.z, aggregate_pos.z, resolution / 100.0);
+  }
+}
+
+
+TEST(Map, RayBatch)
+{
+  // Validate the RayBatch contains the same voxel updates as walking the rays directly, grouped by region and in ray
+  // order within each region.
+  OccupancyMap map(0.25, glm::u8vec3(8));
+  std::mt19937 rand_engine(0x4321u);
+  std::uniform_real_distribution<double> rand(-5.0, 5.0);
+
+  RayBatch batch;
+  const size_t ray_count = 500u;
+  size_t expected_voxel_count = 0;
+  std::vector<Key> walk_keys;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    const glm::dvec3 start(0.0);
+    const glm::dvec3 end(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+    batch.addRay(start, end, i, kExcludeEndVoxel, kRbWalk | kRbSample);
+
+    walk_keys.clear();
+    walkSegmentKeys(LineWalkContext(map,
+                                    [&walk_keys](const Key &key, double, double) {
+                                      walk_keys.emplace_back(key);
+                                      return true;
+                                    }),
+                    start, end, kExcludeEndVoxel);
+    expected_voxel_count += walk_keys.size() + 1;
+  }
+
+  double last_exit_range = 0;
+  batch.build(map, true, &last_exit_range);
+
+  ASSERT_EQ(batch.rays().size(), ray_count);
+  EXPECT_EQ(batch.voxels().size(), expected_voxel_count);
+  EXPECT_GT(last_exit_range, 0.0);
+
+  size_t visited_voxel_count = 0;
+  batch.forEachRegion([&](const RayBatchRegion &region, const RayBatchVoxel *voxels, size_t voxel_count) {
+    ASSERT_NE(region.chunk, nullptr);
+    EXPECT_EQ(region.chunk, map.region(region.region_key));
+    unsigned last_ray_index = 0;
+    for (size_t i = 0; i < voxel_count; ++i)
+    {
+      EXPECT_EQ(voxels[i].key.regionKey(), region.region_key);
+      EXPECT_GE(voxels[i].ray_index, last_ray_index);
+      last_ray_index = voxels[i].ray_index;
+      if (voxels[i].sample)
+      {
+        EXPECT_EQ(voxels[i].key, map.voxelKey(batch.rays()[voxels[i].ray_index].end));
+      }
+    }
+    visited_voxel_count += voxel_count;
+  });
+
+  EXPECT_EQ(visited_voxel_count, expected_voxel_count);
+}
+
+
+TEST(Map, ParallelForEach)
+{
+  // Validate the parallel traversal visits the same voxels as the OccupancyMap::iterator.
+  OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+  ASSERT_GT(map.regionCount(), 1u);
+
+  std::vector<Key> iter_keys;
+  size_t iter_occupied_count = 0;
+  Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    iter_keys.emplace_back(*iter);
+    occupancy.setKey(iter);
+    iter_occupied_count += isOccupied(occupancy) ? 1 : 0;
+  }
+  occupancy.reset();
+  ASSERT_GT(iter_occupied_count, 0u);
+
+  // Visiting the regions in parallel and concatenating the region keys in region order matches the iterator order.
+  const glm::ivec3 region_voxel_dimensions = map.regionVoxelDimensions();
+  std::vector<std::vector<Key>> region_keys(map.regionCount());
+  parallelForEachRegion(map, [&](const MapChunk &chunk, size_t region_index, unsigned worker_index) {
+    EXPECT_LT(worker_index, parallelWorkerCount());
+    forEachVoxelInRegion(chunk, region_voxel_dimensions,
+                         [&region_keys, region_index](const Key &key) { region_keys[region_index].emplace_back(key); });
+  });
+
+  std::vector<Key> parallel_keys;
+  for (const auto &keys : region_keys)
+  {
+    parallel_keys.insert(parallel_keys.end(), keys.begin(), keys.end());
+  }
+  EXPECT_EQ(parallel_keys, iter_keys);
+
+  // Count occupied voxels using per worker voxel references and counts.
+  WorkerLocal<Voxel<const float>> worker_occupancy(Voxel<const float>(&map, map.layout().occupancyLayer()));
+  WorkerLocal<size_t> worker_occupied_count(0u);
+  WorkerLocal<size_t> worker_voxel_count(0u);
+  parallelForEachVoxel(map, [&](const Key &key, const MapChunk &chunk, unsigned worker_index) {
+    Voxel<const float> &voxel = worker_occupancy.local(worker_index);
+    voxel.setKey(key, &chunk);
+    worker_occupied_count.local(worker_index) += isOccupied(voxel) ? 1 : 0;
+    ++worker_voxel_count.local(worker_index);
+  });
+  worker_occupancy.items().clear();
+
+  const auto sum = [](size_t a, size_t b) { return a + b; };
+  EXPECT_EQ(worker_voxel_count.combine(sum), iter_keys.size());
+  EXPECT_EQ(worker_occupied_count.combine(sum), iter_occupied_count);
+
+  // Reduce over the regions with and without threads.
+  for (bool use_threads : { true, false })
+  {
+    const size_t reduced_count = parallelReduceRegions(
+      map, size_t(0u),
+      [&map, &region_voxel_dimensions](const MapChunk &chunk, unsigned /*worker_index*/) {
+        Voxel<const float> voxel(&map, map.layout().occupancyLayer());
+        size_t count = 0;
+        forEachVoxelInRegion(chunk, region_voxel_dimensions, [&voxel, &chunk, &count](const Key &key) {
+          voxel.setKey(key, &chunk);
+          count += isOccupied(voxel) ? 1 : 0;
+        });
+        return count;
+      },
+      sum, use_threads);
+    EXPECT_EQ(reduced_count, iter_occupied_count);
+  }
+}
+
+
+TEST(Map, TaskArena)
+{
+  OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmgen::boxRoom(map, glm::dvec3(-5.0), glm::dvec3(5.0));
+  ASSERT_GT(map.regionCount(), 1u);
+
+  // Restrict parallel operations to a two slot arena.
+  setParallelConcurrency(2u);
+#ifdef OHM_FEATURE_THREADS
+  ASSERT_NE(taskArena(), nullptr);
+  EXPECT_EQ(parallelConcurrency(), 2u);
+#else   // OHM_FEATURE_THREADS
+  EXPECT_EQ(parallelConcurrency(), 1u);
+#endif  // OHM_FEATURE_THREADS
+
+  std::atomic<size_t> visited_count{ 0 };
+  std::atomic<int> max_concurrency{ 0 };
+  parallelForEachRegion(map, [&](const MapChunk & /*chunk*/, size_t /*region_index*/, unsigned worker_index) {
+    EXPECT_LT(worker_index, parallelWorkerCount());
+#ifdef OHM_FEATURE_THREADS
+    const int concurrency = tbb::this_task_arena::max_concurrency();
+    int current = max_concurrency;
+    while (concurrency > current && !max_concurrency.compare_exchange_weak(current, concurrency))
+    {}
+#endif  // OHM_FEATURE_THREADS
+    ++visited_count;
+  });
+  EXPECT_EQ(visited_count, map.regionCount());
+#ifdef OHM_FEATURE_THREADS
+  EXPECT_EQ(max_concurrency, 2);
+#endif  // OHM_FEATURE_THREADS
+
+  // Restore the global scheduler.
+  setParallelConcurrency(0u);
+#ifdef OHM_FEATURE_THREADS
+  EXPECT_EQ(taskArena(), nullptr);
+#endif  // OHM_FEATURE_THREADS
+}
+
+TEST(Map, NumaPlacement)
+{
+  // Validate the NUMA region partition keeps blocks of regions together and spreads blocks between nodes.
+  EXPECT_GE(numaNodeCount(), 1u);
+  const unsigned node_count = 2;
+  std::vector<unsigned> node_blocks(node_count, 0u);
+  for (int bx = -4; bx < 4; ++bx)
+  {
+    for (int by = -4; by < 4; ++by)
+    {
+      const glm::i16vec3 block_key(bx * kNumaRegionBlock, by * kNumaRegionBlock, 0);
+      const unsigned node = regionNumaNode(block_key, node_count);
+      ASSERT_LT(node, node_count);
+      EXPECT_EQ(regionNumaNode(block_key, 1u), 0u);
+      ++node_blocks[node];
+      for (int i = 1; i < kNumaRegionBlock; ++i)
+      {
+        EXPECT_EQ(regionNumaNode(block_key + glm::i16vec3(i, 0, 0), node_count), node);
+        EXPECT_EQ(regionNumaNode(block_key + glm::i16vec3(0, i, i), node_count), node);
+      }
+    }
+  }
+  EXPECT_GT(node_blocks[0], 0u);
+  EXPECT_GT(node_blocks[1], 0u);
+
+  // Each item is visited exactly once, regardless of its node.
+  std::vector<unsigned> item_nodes(1000u);
+  for (size_t i = 0; i < item_nodes.size(); ++i)
+  {
+    item_nodes[i] = unsigned(i % 3u);
+  }
+  std::vector<std::atomic_uint> visits(item_nodes.size());
+  for (auto &visit_count : visits)
+  {
+    visit_count = 0u;
+  }
+  parallelForNuma(item_nodes, [&visits](size_t i) { ++visits[i]; });
+  for (const auto &visit_count : visits)
+  {
+    EXPECT_EQ(visit_count.load(), 1u);
+  }
+
+  // NUMA aware threaded integration matches the single threaded update.
+  OccupancyMap map(0.25, glm::u8vec3(8));
+  OccupancyMap numa_map(0.25, glm::u8vec3(8));
+  const std::vector<glm::dvec3> rays = ohmtestutil::randomRays(glm::dvec3(0.0), 8.0, 4000u, 0x1234u);
+  RayMapperOccupancy(&map).integrateRays(rays.data(), rays.size());
+  RayMapperOccupancy numa_mapper(&numa_map);
+  numa_mapper.setUseThreads(true);
+  numa_mapper.setNumaAware(true);
+  EXPECT_TRUE(numa_mapper.numaAware());
+  numa_mapper.integrateRays(rays.data(), rays.size());
+
+  ASSERT_EQ(map.regionCount(), numa_map.regionCount());
+  std::vector<const MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  for (const MapChunk *chunk : chunks)
+  {
+    const MapChunk *numa_chunk = numa_map.region(chunk->region.coord);
+    ASSERT_NE(numa_chunk, nullptr);
+    VoxelBuffer<const VoxelBlock> buffer(chunk->voxel_blocks[map.layout().occupancyLayer()]);
+    VoxelBuffer<const VoxelBlock> numa_buffer(numa_chunk->voxel_blocks[map.layout().occupancyLayer()]);
+    ASSERT_EQ(buffer.voxelMemorySize(), numa_buffer.voxelMemorySize());
+    EXPECT_EQ(memcmp(buffer.voxelMemory(), numa_buffer.voxelMemory(), buffer.voxelMemorySize()), 0);
+  }
+}
+
+TEST(Map, VoxelOrder)
+{
+  // Validate the voxel orders map each local key to a unique voxel memory index and back.
+  const std::vector<std::pair<VoxelOrder, glm::ivec3>> orders = {
+    { VoxelOrder::kRowMajor, glm::ivec3(12, 8, 6) },
+    { VoxelOrder::kMorton, glm::ivec3(32) },
+    { VoxelOrder::kBrick4, glm::ivec3(32) },
+    { VoxelOrder::kBrick4, glm::ivec3(16, 8, 12) },
+  };
+  for (const auto &order : orders)
+  {
+    const glm::ivec3 &dim = order.second;
+    ASSERT_TRUE(voxelOrderSupported(order.first, dim));
+    std::vector<bool> index_used(dim.x * dim.y * dim.z, false);
+    for (int z = 0; z < dim.z; ++z)
+    {
+      for (int y = 0; y < dim.y; ++y)
+      {
+        for (int x = 0; x < dim.x; ++x)
+        {
+          const glm::u8vec3 local_key(x, y, z);
+          const unsigned index = voxelIndex(local_key, dim, order.first);
+          ASSERT_LT(index, index_used.size());
+          EXPECT_FALSE(index_used[index]);
+          index_used[index] = true;
+          EXPECT_EQ(voxelLocalKey(index, dim, order.first), local_key);
+        }
+      }
+    }
+  }
+
+  // Unsupported dimensions fall back to row major.
+  EXPECT_FALSE(voxelOrderSupported(VoxelOrder::kMorton, glm::ivec3(16, 8, 12)));
+  EXPECT_FALSE(voxelOrderSupported(VoxelOrder::kBrick4, glm::ivec3(16, 8, 10)));
+  EXPECT_EQ(OccupancyMap(0.25, glm::u8vec3(16, 8, 12), MapFlag::kVoxelOrderMorton).voxelOrder(),
+            VoxelOrder::kRowMajor);
+
+  // Validate maps using each voxel order produce the same voxel values for the same rays.
+  const double resolution = 0.25;
+  const glm::u8vec3 region_size(16);
+  OccupancyMap map(resolution, region_size, MapFlag::kVoxelMean);
+  OccupancyMap morton_map(resolution, region_size, MapFlag::kVoxelMean | MapFlag::kVoxelOrderMorton);
+  OccupancyMap brick_map(resolution, region_size, MapFlag::kVoxelMean | MapFlag::kVoxelOrderBrick4);
+  EXPECT_EQ(map.voxelOrder(), VoxelOrder::kRowMajor);
+  EXPECT_EQ(morton_map.voxelOrder(), VoxelOrder::kMorton);
+  EXPECT_EQ(brick_map.voxelOrder(), VoxelOrder::kBrick4);
+  // Voxel memory cannot be copied directly between voxel orders.
+  EXPECT_FALSE(canCopy(morton_map, map));
+
+  std::mt19937 rand_engine(0x1234u);
+  std::uniform_real_distribution<double> rand(-6.0, 6.0);
+  std::vector<glm::dvec3> rays;
+  for (size_t i = 0; i < 2000u; ++i)
+  {
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)) * 0.25);
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  for (OccupancyMap *target : { &map, &morton_map, &brick_map })
+  {
+    RayMapperOccupancy mapper(target);
+    mapper.setUseThreads(true);
+    mapper.integrateRays(rays.data(), rays.size());
+  }
+
+  // Save and reload the Morton map to validate the voxel order is serialised.
+  const char *map_name = "test-map-voxel-order.ohm";
+  ASSERT_EQ(save(map_name, morton_map), 0);
+  OccupancyMap loaded_map(1.0);
+  ASSERT_EQ(load(map_name, loaded_map), 0);
+  EXPECT_EQ(loaded_map.voxelOrder(), VoxelOrder::kMorton);
+
+  const glm::ivec3 region_voxel_dimensions = map.regionVoxelDimensions();
+  for (const OccupancyMap *ordered_map : { &morton_map, &brick_map, &loaded_map })
+  {
+    ASSERT_EQ(ordered_map->regionCount(), map.regionCount());
+    Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+    Voxel<const VoxelMean> mean(&map, map.layout().meanLayer());
+    Voxel<const float> ordered_occupancy(ordered_map, ordered_map->layout().occupancyLayer());
+    Voxel<const VoxelMean> ordered_mean(ordered_map, ordered_map->layout().meanLayer());
+    ASSERT_EQ(ordered_occupancy.layerVoxelOrder(), ordered_map->voxelOrder());
+
+    size_t voxel_count = 0;
+    size_t ordered_voxel_count = 0;
+    for (auto iter = map.begin(); iter != map.end(); ++iter)
+    {
+      ++voxel_count;
+      setVoxelKey(iter, occupancy, mean);
+      ordered_occupancy.setKey(*iter);
+      ordered_mean.setKey(*iter);
+      ASSERT_TRUE(ordered_occupancy.isValid());
+      ASSERT_EQ(ordered_occupancy.chunk()->first_valid_index, occupancy.chunk()->first_valid_index);
+      EXPECT_EQ(ordered_occupancy.data(), occupancy.data());
+      EXPECT_EQ(ordered_mean.data().coord, mean.data().coord);
+      EXPECT_EQ(ordered_mean.data().count, mean.data().count);
+
+      // Validate the voxel memory is actually reordered.
+      VoxelBuffer<const VoxelBlock> buffer(ordered_occupancy.chunk()->voxel_blocks[ordered_occupancy.layerIndex()]);
+      float raw_value = 0;
+      buffer.readVoxel(voxelIndex(*iter, region_voxel_dimensions, ordered_map->voxelOrder()), &raw_value);
+      EXPECT_EQ(raw_value, occupancy.data());
+    }
+    for (auto iter = ordered_map->begin(); iter != ordered_map->end(); ++iter)
+    {
+      ++ordered_voxel_count;
+    }
+    EXPECT_EQ(ordered_voxel_count, voxel_count);
+  }
+}
+
+
+TEST(Map, RegionIndexer)
+{
+  // Power of two and general dimensions must give identical results to the general functions.
+  const glm::ivec3 dimensions[] = { glm::ivec3(32), glm::ivec3(8, 16, 4), glm::ivec3(10), glm::ivec3(32, 32, 3) };
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_int_distribution<int> step_rand(-100, 100);
+  for (const glm::ivec3 &dim : dimensions)
+  {
+    const RegionIndexer indexer(dim);
+    EXPECT_EQ(indexer.isPowerOfTwo(), dim != glm::ivec3(10) && dim != glm::ivec3(32, 32, 3));
+
+    const unsigned volume = unsigned(dim.x * dim.y * dim.z);
+    for (unsigned i = 0; i < volume; ++i)
+    {
+      const glm::u8vec3 local_key = voxelLocalKey(i, dim);
+      ASSERT_EQ(indexer.localKey(i), local_key);
+      ASSERT_EQ(indexer.index(local_key), i);
+    }
+
+    // Compare key movement against global voxel coordinates.
+    OccupancyMap map(1.0, glm::u8vec3(dim));
+    for (int i = 0; i < 1000; ++i)  // NOLINT(readability-magic-numbers)
+    {
+      Key key(glm::i16vec3(step_rand(rand_engine)), glm::u8vec3(0));
+      key.setLocalKey(indexer.localKey(unsigned(std::abs(step_rand(rand_engine))) % volume));
+      const glm::ivec3 step(step_rand(rand_engine), step_rand(rand_engine), step_rand(rand_engine));
+      const glm::ivec3 expected = glm::ivec3(key.regionKey()) * dim + glm::ivec3(key.localKey()) + step;
+
+      Key moved = key;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        indexer.moveKeyAlongAxis(moved, axis, step[axis]);
+      }
+      EXPECT_EQ(glm::ivec3(moved.regionKey()) * dim + glm::ivec3(moved.localKey()), expected);
+      EXPECT_TRUE(glm::all(glm::lessThan(glm::ivec3(moved.localKey()), dim)));
+
+      Key map_moved = key;
+      map.moveKey(map_moved, step.x, step.y, step.z);
+      EXPECT_EQ(map_moved, moved);
+    }
+  }
+}
+
+
+TEST(Map, ConcurrentRegions)
+{
+  // Validate concurrent region creation and lookup, with culling running alongside.
+  OccupancyMap map(1.0, glm::u8vec3(4));
+  const int extent = 12;
+  const unsigned thread_count = 4;
+
+  // Each thread creates all regions in the extents, in a different order. All threads must see the same chunks.
+  std::vector<std::vector<MapChunk *>> thread_chunks(thread_count);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < thread_count; ++t)
+  {
+    threads.emplace_back([&map, &thread_chunks, t]() {
+      std::vector<MapChunk *> &chunks = thread_chunks[t];
+      for (int z = -extent; z < extent; ++z)
+      {
+        for (int y = -extent; y < extent; ++y)
+        {
+          for (int x = -extent; x < extent; ++x)
+          {
+            // Odd threads walk x/y in reverse over the same range.
+            const glm::i16vec3 region_key((t % 2 == 0) ? x : -1 - x, (t % 2 == 0) ? y : -1 - y, z);
+            MapChunk *chunk = map.region(region_key, true);
+            EXPECT_NE(chunk, nullptr);
+            EXPECT_EQ(chunk->region.coord, region_key);
+            chunks.emplace_back(chunk);
+          }
+        }
+      }
+    });
+  }
+
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  threads.clear();
+
+  const size_t region_count = size_t(2 * extent) * size_t(2 * extent) * size_t(2 * extent);
+  EXPECT_EQ(map.regionCount(), region_count);
+  for (unsigned t = 0; t < thread_count; ++t)
+  {
+    ASSERT_EQ(thread_chunks[t].size(), region_count);
+    for (MapChunk *chunk : thread_chunks[t])
+    {
+      EXPECT_EQ(map.region(chunk->region.coord), chunk);
+    }
+  }
+
+  // Cull the negative Z regions while reading the positive Z regions.
+  std::atomic_bool reading_ok(true);
+  threads.emplace_back([&map, &reading_ok]() {
+    for (int z = 0; z < extent; ++z)
+    {
+      for (int y = -extent; y < extent; ++y)
+      {
+        for (int x = -extent; x < extent; ++x)
+        {
+          const glm::i16vec3 region_key(x, y, z);
+          const MapChunk *chunk = static_cast<const OccupancyMap &>(map).region(region_key);
+          if (!chunk || chunk->region.coord != region_key)
+          {
+            reading_ok = false;
+          }
+        }
+      }
+    }
+  });
+  const unsigned removed = map.cullRegionsOutside(glm::dvec3(-1000, -1000, 0), glm::dvec3(1000, 1000, 1000));
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  EXPECT_TRUE(reading_ok);
+  EXPECT_EQ(removed, region_count / 2);
+  EXPECT_EQ(map.regionCount(), region_count / 2);
+
+  // Re-create a culled region.
+  const glm::i16vec3 culled_key(0, 0, -1);
+  EXPECT_EQ(static_cast<const OccupancyMap &>(map).region(culled_key), nullptr);
+  MapChunk *chunk = map.region(culled_key, true);
+  ASSERT_NE(chunk, nullptr);
+  EXPECT_EQ(map.region(culled_key), chunk);
+  EXPECT_EQ(map.regionCount(), region_count / 2 + 1);
+}
+
+
+TEST(Map, RegionPaging)
+{
+  // Validate a map with region paging matches a fully resident map while sweeping the sensor so that regions are
+  // paged out and back in.
+  const double resolution = 0.25;
+  const glm::u8vec3 region_size(8);
+  OccupancyMap map(resolution, region_size, MapFlag::kVoxelMean);
+  OccupancyMap paged_map(resolution, region_size, MapFlag::kVoxelMean);
+
+  size_t region_bytes = 0;
+  for (size_t i = 0; i < paged_map.layout().layerCount(); ++i)
+  {
+    region_bytes += paged_map.layout().layer(i).layerByteSize(paged_map.regionVoxelDimensions());
+  }
+
+  const char *backing_file = "test-region-paging.ohmpage";
+  const size_t resident_regions = 64u;
+  ASSERT_TRUE(paged_map.enableRegionPaging(backing_file, resident_regions * region_bytes, 2.0));
+  EXPECT_TRUE(paged_map.regionPagingEnabled());
+  EXPECT_EQ(paged_map.regionPagingBudget(), resident_regions * region_bytes);
+
+  // Sweep the sensor out and back along X so regions are paged out, then revisited.
+  std::mt19937 rand_engine(0x5678u);
+  std::uniform_real_distribution<double> rand(-3.0, 3.0);
+  RayMapperOccupancy mapper(&map);
+  RayMapperOccupancy paged_mapper(&paged_map);
+  std::vector<glm::dvec3> rays;
+  size_t max_paged_out = 0;
+  for (int step = -20; step <= 20; ++step)
+  {
+    const glm::dvec3 origin(20.0 - std::abs(double(step)), 0, 0);
+    rays.clear();
+    for (size_t i = 0; i < 500u; ++i)
+    {
+      rays.emplace_back(origin);
+      rays.emplace_back(origin + glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+    }
+
+    mapper.integrateRays(rays.data(), rays.size());
+    paged_mapper.integrateRays(rays.data(), rays.size());
+    max_paged_out = std::max(max_paged_out, paged_map.pagedOutRegionCount());
+  }
+
+  EXPECT_GT(max_paged_out, 0u);
+  EXPECT_GT(paged_map.pagedOutRegionCount(), 0u);
+  EXPECT_EQ(paged_map.regionCount() + paged_map.pagedOutRegionCount(), map.regionCount());
+
+  // Explicit paging respects the budget, keeping the hot spot resident.
+  paged_map.updateRegionPaging(glm::dvec3(0));
+  EXPECT_LE(paged_map.regionCount(), resident_regions);
+  EXPECT_NE(static_cast<const OccupancyMap &>(paged_map).region(paged_map.regionKey(glm::dvec3(0))), nullptr);
+
+  // Comparing chunks pages in regions via region().
+  ohmtestutil::compareMaps(paged_map, map, ohmtestutil::kCfCompareExtended & ~ohmtestutil::kCfGeneral);
+  EXPECT_EQ(paged_map.pagedOutRegionCount(), 0u);
+
+  paged_map.updateRegionPaging(glm::dvec3(0));
+  EXPECT_GT(paged_map.pagedOutRegionCount(), 0u);
+  paged_map.disableRegionPaging();
+  EXPECT_FALSE(paged_map.regionPagingEnabled());
+  EXPECT_EQ(paged_map.regionCount(), map.regionCount());
+  ohmtestutil::compareMaps(paged_map, map, ohmtestutil::kCfCompareExtended);
+
+  // The backing file is removed.
+  std::ifstream backing_in(backing_file);
+  EXPECT_FALSE(backing_in.is_open());
+}
+
+
+TEST(Map, VoxelMemoryPool)
+{
+  // Validate region memory is recycled by a rolling window of regions.
+  const glm::u8vec3 region_size(8);
+  OccupancyMap map(0.1, region_size, MapFlag::kVoxelMean);
+  VoxelMemoryPool &pool = map.voxelMemoryPool();
+  EXPECT_EQ(pool.byteLimit(), VoxelMemoryPool::kDefaultByteLimit);
+
+  size_t region_bytes = 0;
+  for (size_t i = 0; i < map.layout().layerCount(); ++i)
+  {
+    region_bytes += map.layout().layer(i).layerByteSize(map.regionVoxelDimensions());
+  }
+
+  // Slide a window of 4x4x1 regions along x, culling regions which leave the window.
+  const int window = 4;
+  const int steps = 20;
+  for (int step = 0; step < steps; ++step)
+  {
+    for (int y = 0; y < window; ++y)
+    {
+      for (int x = step; x < step + window; ++x)
+      {
+        ASSERT_NE(map.region(glm::i16vec3(x, y, 0), true), nullptr);
+      }
+    }
+    const glm::dvec3 window_min = map.regionCentreGlobal(glm::i16vec3(step + 1, 0, 0)) -
+                                  0.5 * map.regionSpatialResolution();
+    map.cullRegionsOutside(window_min, window_min + glm::dvec3(window * 10.0));
+  }
+
+  // After the first step, each new column of regions should reuse memory.
+  VoxelMemoryPoolStats stats = pool.stats();
+  const size_t new_regions = size_t(window) * size_t(steps - 1);
+  EXPECT_GE(stats.recycle_count, new_regions * map.layout().layerCount() - window * map.layout().layerCount());
+  EXPECT_LE(stats.pooled_bytes, pool.byteLimit());
+  EXPECT_LE(stats.pooled_bytes, size_t(window) * region_bytes);
+  EXPECT_EQ(stats.discard_count, 0u);
+
+  // Reducing the limit frees pooled memory and a zero limit disables pooling.
+  pool.setByteLimit(0);
+  EXPECT_EQ(pool.stats().pooled_bytes, 0u);
+  EXPECT_EQ(pool.stats().pooled_buffers, 0u);
+  map.clear();
+  stats = pool.stats();
+  EXPECT_EQ(stats.pooled_bytes, 0u);
+  EXPECT_GT(stats.discard_count, 0u);
+}
+
+TEST(Map, HugePages)
+{
+  // Validate voxel memory is packed into huge pages when enabled and the pages are released with the map.
+  HugePageAllocator &allocator = HugePageAllocator::instance();
+  const HugePageMode restore_mode = allocator.mode();
+  allocator.setMode(HugePageMode::kTransparent);
+  const HugePageStats initial_stats = allocator.stats();
+  EXPECT_EQ(initial_stats.page_size, HugePageAllocator::kPageSize);
+
+  {
+    OccupancyMap map(0.1, glm::u8vec3(32), MapFlag::kNone);
+    const int region_count = 64;
+    for (int i = 0; i < region_count; ++i)
+    {
+      ASSERT_NE(map.region(glm::i16vec3(i, 0, 0), true), nullptr);
+    }
+
+#ifdef __linux__
+    // Blocks are packed contiguously: each page holds a single allocation size and is filled before mapping the next.
+    size_t expected_blocks = 0;
+    size_t expected_pages = 0;
+    for (size_t i = 0; i < map.layout().layerCount(); ++i)
+    {
+      const size_t layer_bytes = map.layout().layer(i).layerByteSize(map.regionVoxelDimensions());
+      if (layer_bytes >= HugePageAllocator::kMinBlockSize && layer_bytes <= HugePageAllocator::kPageSize / 2)
+      {
+        const size_t stride =
+          (layer_bytes + HugePageAllocator::kSlotAlignment - 1) & ~(HugePageAllocator::kSlotAlignment - 1);
+        const size_t blocks_per_page = HugePageAllocator::kPageSize / stride;
+        expected_blocks += region_count;
+        expected_pages += (region_count + blocks_per_page - 1) / blocks_per_page;
+      }
+    }
+    ASSERT_GT(expected_blocks, 0u);
+    const HugePageStats stats = allocator.stats();
+    EXPECT_EQ(stats.block_count - initial_stats.block_count, expected_blocks);
+    EXPECT_EQ(stats.page_count - initial_stats.page_count, expected_pages);
+    EXPECT_GT(stats.utilisation(), 0.0);
+#endif  // __linux__
+
+    // Voxel memory is usable.
+    Voxel<float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(glm::dvec3(0.05)));
+    ASSERT_TRUE(voxel.isValid());
+    integrateHit(voxel);
+    EXPECT_TRUE(isOccupied(voxel));
+  }
+
+  // All pages are released with the map, including those held by its memory pool.
+  const HugePageStats final_stats = allocator.stats();
+  EXPECT_EQ(final_stats.block_count, initial_stats.block_count);
+  EXPECT_EQ(final_stats.page_count, initial_stats.page_count);
+  allocator.setMode(restore_mode);
+}
+
+TEST(Map, RollingWindow)
+{
+  // Validate regions leaving the rolling window are removed and recycled by regions entering the window.
+  const glm::u8vec3 region_size(8);
+  OccupancyMap map(0.1, region_size);
+  EXPECT_FALSE(map.rollingWindowEnabled());
+  EXPECT_EQ(map.moveRollingWindow(glm::dvec3(0)), 0u);
+
+  // An existing region outside the window is removed on enabling.
+  ASSERT_NE(map.region(glm::i16vec3(-10, 0, 0), true), nullptr);
+  EXPECT_EQ(map.enableRollingWindow(glm::ivec3(4), glm::dvec3(0)), 1u);
+  EXPECT_TRUE(map.rollingWindowEnabled());
+  EXPECT_EQ(map.rollingWindowDimensions(), glm::ivec3(4));
+
+  glm::i16vec3 min_key(0);
+  glm::i16vec3 max_key(0);
+  ASSERT_TRUE(map.rollingWindowKeys(&min_key, &max_key));
+  EXPECT_EQ(min_key, glm::i16vec3(-2));
+  EXPECT_EQ(max_key, glm::i16vec3(1));
+
+  // Populate the window and one region outside.
+  for (int z = min_key.z; z <= max_key.z; ++z)
+  {
+    for (int y = min_key.y; y <= max_key.y; ++y)
+    {
+      for (int x = min_key.x; x <= max_key.x; ++x)
+      {
+        ASSERT_NE(map.region(glm::i16vec3(x, y, z), true), nullptr);
+      }
+    }
+  }
+  ASSERT_NE(map.region(glm::i16vec3(10, 0, 0), true), nullptr);
+  EXPECT_EQ(map.regionCount(), 65u);
+
+  // Mark a region which will leave the window.
+  const glm::i16vec3 leaving_key(-2, 0, 0);
+  const MapChunk *leaving_chunk = map.region(leaving_key, false);
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer(), Key(leaving_key, 0, 0, 0));
+    ASSERT_TRUE(voxel.isValid());
+    integrateHit(voxel);
+  }
+
+  // Moving within the same region only removes the outside region.
+  EXPECT_EQ(map.moveRollingWindow(glm::dvec3(0.01)), 1u);
+  EXPECT_EQ(map.regionCount(), 64u);
+
+  // Move one region along X. A 4x4 slab leaves the window.
+  EXPECT_EQ(map.moveRollingWindow(map.regionCentreGlobal(glm::i16vec3(1, 0, 0))), 16u);
+  EXPECT_EQ(map.regionCount(), 48u);
+  EXPECT_EQ(map.region(leaving_key, false), nullptr);
+
+  // The entering region shares the slot of the leaving region and recycles its chunk, cleared in place.
+  const glm::i16vec3 entering_key(2, 0, 0);
+  const MapChunk *entering_chunk = map.region(entering_key, true);
+  ASSERT_NE(entering_chunk, nullptr);
+  EXPECT_EQ(entering_chunk, leaving_chunk);
+  EXPECT_EQ(entering_chunk->region.coord, entering_key);
+  EXPECT_FALSE(entering_chunk->hasValidNodes());
+  {
+    Voxel<const float> voxel(&map, map.layout().occupancyLayer(), Key(entering_key, 0, 0, 0));
+    ASSERT_TRUE(voxel.isValid());
+    EXPECT_TRUE(isUnobserved(voxel));
+  }
+
+  // Culled regions within the window are kept for recycling too.
+  EXPECT_EQ(map.expireRegions(1.0), 49u);
+  EXPECT_EQ(map.regionCount(), 0u);
+  EXPECT_EQ(map.region(entering_key, true), entering_chunk);
+
+  map.disableRollingWindow();
+  EXPECT_FALSE(map.rollingWindowEnabled());
+  EXPECT_EQ(map.regionCount(), 1u);
+}
+
+TEST(Map, RebaseOrigin)
+{
+  // Validate rebasing preserves the global position of voxels, re-keys regions and only removes regions which leave
+  // the key range when requested.
+  const double resolution = 0.5;
+  const glm::u8vec3 region_size(8);
+  OccupancyMap map(resolution, region_size);
+  const glm::dvec3 region_extents = map.regionSpatialResolution();
+
+  // Mark voxels in the origin region and the region at the key limit.
+  const glm::dvec3 origin_point(0.3, -0.7, 1.1);
+  const glm::dvec3 limit_point = map.regionCentreGlobal(glm::i16vec3(32767, 0, 0));
+  for (const glm::dvec3 &point : { origin_point, limit_point })
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(point));
+    ASSERT_TRUE(voxel.isValid());
+    integrateHit(voxel);
+  }
+  EXPECT_EQ(map.regionCount(), 2u);
+  EXPECT_EQ(map.regionKeyHeadroom(limit_point), 0);
+  EXPECT_LT(map.regionKeyHeadroom(limit_point + glm::dvec3(region_extents.x, 0, 0)), 0);
+
+  // Rebase by a whole number of regions around a point beyond the key limit. The origin region would leave the key
+  // range, so this fails without opting in to removing it.
+  const glm::dvec3 centre = limit_point + glm::dvec3(100.0 * region_extents.x, 0, 0);
+  size_t removed_count = 1;
+  EXPECT_FALSE(map.rebaseOrigin(centre, &removed_count));
+  EXPECT_EQ(removed_count, 0u);
+  EXPECT_EQ(map.regionCount(), 2u);
+  EXPECT_EQ(map.origin(), glm::dvec3(0));
+  EXPECT_EQ(map.rebaseOffset(), glm::dvec3(0));
+  EXPECT_NE(map.region(glm::i16vec3(32767, 0, 0), false), nullptr);
+
+  ASSERT_TRUE(map.rebaseOrigin(centre, &removed_count, true));
+  EXPECT_EQ(removed_count, 1u);
+  EXPECT_EQ(map.regionCount(), 1u);
+  EXPECT_EQ(map.regionKey(centre), glm::i16vec3(0));
+  EXPECT_EQ(map.regionKeyHeadroom(centre), 32767);
+  EXPECT_EQ(map.origin(), glm::dvec3(32867.0 * region_extents.x, 0, 0));
+  EXPECT_EQ(map.rebaseOffset(), glm::dvec3(32867, 0, 0));
+
+  // Keys cached before the rebase map onto the new keys by the rebase offset.
+  glm::i16vec3 region_key(32767, 0, 0);
+  EXPECT_TRUE(OccupancyMap::shiftRegionKey(region_key, map.rebaseOffset()));
+  EXPECT_EQ(region_key, glm::i16vec3(-100, 0, 0));
+  region_key = glm::i16vec3(0);
+  EXPECT_FALSE(OccupancyMap::shiftRegionKey(region_key, map.rebaseOffset()));
+  EXPECT_EQ(region_key, glm::i16vec3(0));
+
+  // The limit region now sits at key -100 and retains its voxel at the same global position.
+  const MapChunk *chunk = map.region(glm::i16vec3(-100, 0, 0), false);
+  ASSERT_NE(chunk, nullptr);
+  EXPECT_EQ(chunk->region.coord, glm::i16vec3(-100, 0, 0));
+  EXPECT_EQ(map.regionCentreGlobal(chunk->region.coord), limit_point);
+  {
+    Voxel<const float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(limit_point));
+    ASSERT_TRUE(voxel.isValid());
+    EXPECT_TRUE(isOccupied(voxel));
+  }
+
+  // Rebasing within the origin region changes nothing.
+  ASSERT_TRUE(map.rebaseOrigin(centre + glm::dvec3(0.1)));
+  EXPECT_EQ(map.region(glm::i16vec3(-100, 0, 0), false), chunk);
+  EXPECT_EQ(map.rebaseOffset(), glm::dvec3(32867, 0, 0));
+}
+
+TEST(Map, Statistics)
+{
+  // Validate the map statistics against the voxels written and that only modified regions are re-examined.
+  const double resolution = 0.5;
+  const glm::u8vec3 region_size(8);
+  OccupancyMap map(resolution, region_size);
+  const std::vector<glm::dvec3> hits = { glm::dvec3(0.2, 0.2, 0.2), glm::dvec3(-3.2, 1.1, 0.4),
+                                         glm::dvec3(5.3, -2.6, 7.9) };
+  const std::vector<glm::dvec3> misses = { glm::dvec3(1.2, 0.2, 0.2), glm::dvec3(-6.1, 0.1, 0.1) };
+
+  glm::dvec3 expected_min(std::numeric_limits<double>::max());
+  glm::dvec3 expected_max(-std::numeric_limits<double>::max());
+  for (const glm::dvec3 &point : hits)
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(point));
+    ASSERT_TRUE(voxel.isValid());
+    integrateHit(voxel);
+  }
+  for (const glm::dvec3 &point : misses)
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(point));
+    ASSERT_TRUE(voxel.isValid());
+    integrateMiss(voxel);
+  }
+  for (const auto *points : { &hits, &misses })
+  {
+    for (const glm::dvec3 &point : *points)
+    {
+      const glm::dvec3 centre = map.voxelCentreGlobal(map.voxelKey(point));
+      expected_min = glm::min(expected_min, centre - glm::dvec3(0.5 * resolution));
+      expected_max = glm::max(expected_max, centre + glm::dvec3(0.5 * resolution));
+    }
+  }
+
+  const size_t region_voxels = size_t(region_size.x) * region_size.y * region_size.z;
+  MapStatistics stats = map.calculateStatistics();
+  EXPECT_EQ(stats.region_count, map.regionCount());
+  EXPECT_EQ(stats.observed_region_count, map.regionCount());
+  EXPECT_EQ(stats.rebuilt_region_count, map.regionCount());
+  EXPECT_EQ(stats.occupied_count, hits.size());
+  EXPECT_EQ(stats.free_count, misses.size());
+  EXPECT_EQ(stats.unobserved_count, map.regionCount() * region_voxels - hits.size() - misses.size());
+  ASSERT_TRUE(stats.observed());
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_NEAR(stats.min_observed[i], expected_min[i], 1e-9);
+    EXPECT_NEAR(stats.max_observed[i], expected_max[i], 1e-9);
+  }
+  EXPECT_EQ(map.voxelCentreGlobal(stats.observed_keys.minKey()),
+            map.voxelCentreGlobal(map.voxelKey(expected_min + glm::dvec3(0.5 * resolution))));
+  EXPECT_EQ(map.voxelCentreGlobal(stats.observed_keys.maxKey()),
+            map.voxelCentreGlobal(map.voxelKey(expected_max - glm::dvec3(0.5 * resolution))));
+
+  glm::dvec3 min_ext;
+  glm::dvec3 max_ext;
+  ASSERT_TRUE(map.calculateObservedExtents(&min_ext, &max_ext));
+  EXPECT_EQ(min_ext, stats.min_observed);
+  EXPECT_EQ(max_ext, stats.max_observed);
+
+  // No changes: nothing to rebuild.
+  stats = map.calculateStatistics();
+  EXPECT_EQ(stats.rebuilt_region_count, 0u);
+
+  // Make a free voxel occupied. Only its region is rebuilt.
+  {
+    Voxel<float> voxel(&map, map.layout().occupancyLayer(), map.voxelKey(misses.front()));
+    ASSERT_TRUE(voxel.isValid());
+    while (!isOccupied(voxel))
+    {
+      integrateHit(voxel);
+    }
+  }
+  stats = map.calculateStatistics();
+  EXPECT_EQ(stats.rebuilt_region_count, 1u);
+  EXPECT_EQ(stats.occupied_count, hits.size() + 1);
+  EXPECT_EQ(stats.free_count, misses.size() - 1);
+
+  // Rebasing re-keys the regions without invalidating their statistics. The observed key range shifts with the keys.
+  const glm::dvec3 min_key_centre = map.voxelCentreGlobal(stats.observed_keys.minKey());
+  const glm::dvec3 max_key_centre = map.voxelCentreGlobal(stats.observed_keys.maxKey());
+  const glm::dvec3 rebase_centre(10.0, -5.0, 0);
+  const glm::i16vec3 rebase_key = map.regionKey(rebase_centre);
+  ASSERT_NE(rebase_key, glm::i16vec3(0));
+  ASSERT_TRUE(map.rebaseOrigin(rebase_centre));
+  EXPECT_EQ(map.rebaseOffset(), glm::dvec3(rebase_key));
+
+  const MapStatistics rebased_stats = map.calculateStatistics();
+  EXPECT_EQ(rebased_stats.rebuilt_region_count, 0u);
+  EXPECT_EQ(rebased_stats.region_count, stats.region_count);
+  EXPECT_EQ(rebased_stats.occupied_count, stats.occupied_count);
+  EXPECT_EQ(rebased_stats.free_count, stats.free_count);
+  EXPECT_EQ(rebased_stats.unobserved_count, stats.unobserved_count);
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_NEAR(rebased_stats.min_observed[i], stats.min_observed[i], 1e-9);
+    EXPECT_NEAR(rebased_stats.max_observed[i], stats.max_observed[i], 1e-9);
+  }
+  EXPECT_EQ(rebased_stats.observed_keys.minKey().regionKey(),
+            glm::i16vec3(stats.observed_keys.minKey().regionKey() - rebase_key));
+  EXPECT_EQ(rebased_stats.observed_keys.maxKey().regionKey(),
+            glm::i16vec3(stats.observed_keys.maxKey().regionKey() - rebase_key));
+  const glm::dvec3 rebased_min_centre = map.voxelCentreGlobal(rebased_stats.observed_keys.minKey());
+  const glm::dvec3 rebased_max_centre = map.voxelCentreGlobal(rebased_stats.observed_keys.maxKey());
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_NEAR(rebased_min_centre[i], min_key_centre[i], 1e-9);
+    EXPECT_NEAR(rebased_max_centre[i], max_key_centre[i], 1e-9);
+  }
+}
+
+TEST(Map, MemoryAccounting)
+{
+  // Validate the per layer accounting tracks region creation, compression and removal.
+  const glm::u8vec3 region_size(16);
+  OccupancyMap map(0.1, region_size, MapFlag::kVoxelMean);
+  const unsigned layer_count = unsigned(map.layout().layerCount());
+  const int region_count = 8;
+  for (int i = 0; i < region_count; ++i)
+  {
+    ASSERT_NE(map.region(glm::i16vec3(i, 0, 0), true), nullptr);
+  }
+
+  MapMemoryUsage usage = map.memoryUsage();
+  ASSERT_EQ(usage.layers.size(), layer_count);
+  size_t region_bytes = 0;
+  for (unsigned i = 0; i < layer_count; ++i)
+  {
+    const size_t layer_bytes = map.layout().layer(i).layerByteSize(map.regionVoxelDimensions());
+    EXPECT_EQ(usage.layers[i].uncompressed_bytes, size_t(region_count) * layer_bytes);
+    EXPECT_EQ(usage.layers[i].compressed_bytes, 0u);
+    EXPECT_EQ(usage.layers[i].gpu_bytes, 0u);
+    region_bytes += layer_bytes;
+  }
+  EXPECT_EQ(usage.hostBytes(), size_t(region_count) * region_bytes);
+  EXPECT_EQ(map.memoryAccounting().hostBytes(), usage.hostBytes());
+
+  // Uncompressed maps can only meet the budget via the budget function. Cull regions until within budget.
+  const size_t budget = size_t(region_count / 2) * region_bytes;
+  const glm::dvec3 keep_max = map.regionCentreGlobal(glm::i16vec3(region_count / 2 - 1, 0, 0));
+  unsigned budget_calls = 0;
+  map.setMemoryBudget(budget, [&budget_calls, &keep_max](OccupancyMap &budget_map, const MapMemoryUsage &budget_usage) {
+    ++budget_calls;
+    EXPECT_GT(budget_usage.hostBytes(), budget_map.memoryBudget());
+    budget_map.cullRegionsOutside(glm::dvec3(-1e3), keep_max);
+  });
+  EXPECT_EQ(map.memoryBudget(), budget);
+  EXPECT_TRUE(map.enforceMemoryBudget());
+  EXPECT_EQ(budget_calls, 1u);
+  EXPECT_EQ(map.regionCount(), size_t(region_count / 2));
+  EXPECT_EQ(map.memoryUsage().hostBytes(), budget);
+
+  // Within budget: nothing to do.
+  EXPECT_TRUE(map.enforceMemoryBudget());
+  EXPECT_EQ(budget_calls, 1u);
+
+  map.clear();
+  EXPECT_EQ(map.memoryUsage().hostBytes(), 0u);
+}
+
+TEST(Map, MemoryBudgetCompression)
+{
+  // Validate compression is used to meet the memory budget before calling the budget function.
+  const glm::u8vec3 region_size(16);
+  OccupancyMap map(0.1, region_size, MapFlag::kCompressed);
+  const int region_count = 8;
+  for (int i = 0; i < region_count; ++i)
+  {
+    ASSERT_NE(map.region(glm::i16vec3(i, 0, 0), true), nullptr);
+  }
+
+  // Cleared voxel data compresses to a small fraction of the uncompressed size.
+  const size_t region_bytes =
+    map.layout().layer(map.layout().occupancyLayer()).layerByteSize(map.regionVoxelDimensions());
+  bool budget_called = false;
+  map.setMemoryBudget(region_bytes, [&budget_called](OccupancyMap &, const MapMemoryUsage &) { budget_called = true; });
+  EXPECT_TRUE(map.enforceMemoryBudget());
+  EXPECT_FALSE(budget_called);
+  EXPECT_EQ(map.regionCount(), size_t(region_count));
+
+  const MapMemoryUsage usage = map.memoryUsage();
+  EXPECT_LE(usage.hostBytes(), region_bytes);
+  EXPECT_GT(usage.compressed_bytes, 0u);
+}
+
+TEST(Map, MemoryTrack)
+{
+  if (!memorytrack::kEnabled)
+  {
+    GTEST_SKIP() << "Memory tracking requires OHM_MEMORY_TRACK";
+  }
+
+  // Validate KeyList growth and release is tracked, including copies.
+  const MemorySubsystemStats initial = memorytrack::stats(MemorySubsystem::kKeyList);
+  {
+    KeyList keys;
+    keys.reserve(1000);  // NOLINT(readability-magic-numbers)
+    const size_t key_bytes = keys.capacity() * sizeof(Key);
+    MemorySubsystemStats stats = memorytrack::stats(MemorySubsystem::kKeyList);
+    EXPECT_EQ(stats.current_bytes, initial.current_bytes + key_bytes);
+    EXPECT_GE(stats.peak_bytes, stats.current_bytes);
+    EXPECT_EQ(stats.allocations, initial.allocations + 1u);
+    EXPECT_EQ(stats.allocated_bytes, initial.allocated_bytes + key_bytes);
+
+    const KeyList copy(keys);  // NOLINT(performance-unnecessary-copy-initialization)
+    stats = memorytrack::stats(MemorySubsystem::kKeyList);
+    EXPECT_EQ(stats.current_bytes, initial.current_bytes + 2u * key_bytes);
+    EXPECT_EQ(stats.allocations, initial.allocations + 2u);
+  }
+
+  MemorySubsystemStats stats = memorytrack::stats(MemorySubsystem::kKeyList);
+  EXPECT_EQ(stats.current_bytes, initial.current_bytes);
+  EXPECT_GE(stats.peak_bytes, stats.current_bytes + 2u * 1000u * sizeof(Key));
+
+  memorytrack::resetPeaks();
+  memorytrack::resetCounts();
+  stats = memorytrack::stats(MemorySubsystem::kKeyList);
+  EXPECT_EQ(stats.peak_bytes, stats.current_bytes);
+  EXPECT_EQ(stats.allocations, 0u);
+  EXPECT_EQ(stats.allocated_bytes, 0u);
+}
+
+
+TEST(Map, Preallocate)
+{
+  const glm::u8vec3 region_size(8);
+  OccupancyMap map(0.1, region_size);
+  const glm::dvec3 region_dim = map.regionSpatialResolution();
+
+  // Preallocate a 3x2x1 block of regions, bounded by region centres.
+  const uint64_t stamp = map.stamp();
+  const Aabb box(glm::dvec3(0.0), glm::dvec3(2.0, 1.0, 0.0) * region_dim);
+  EXPECT_EQ(map.preallocateRegions(box), 6u);
+  EXPECT_EQ(map.regionCount(), 6u);
+  // Existing regions are not counted again.
+  EXPECT_EQ(map.preallocateRegions(box), 0u);
+  for (int x = 0; x < 3; ++x)
+  {
+    for (int y = 0; y < 2; ++y)
+    {
+      EXPECT_NE(map.region(glm::i16vec3(x, y, 0)), nullptr);
+    }
+  }
+  // Preallocation does not touch the map.
+  EXPECT_EQ(map.stamp(), stamp);
+
+  // Preallocate along a path using a background thread. Every region within the radius of a path point must be
+  // created.
+  const std::vector<glm::dvec3> path = { glm::dvec3(-3.0, 0, 0), glm::dvec3(3.0, 0, 0), glm::dvec3(3.0, 4.0, 0) };
+  const double radius = 0.5;
+  {
+    RegionPreallocator preallocator(map);
+    preallocator.preallocateAlongPath(path, radius);
+    preallocator.wait();
+    EXPECT_EQ(preallocator.pendingCount(), 0u);
+    EXPECT_GT(preallocator.preallocatedCount(), 0u);
+    EXPECT_EQ(map.regionCount(), 6u + preallocator.preallocatedCount());
+  }
+
+  for (size_t i = 0; i + 1 < path.size(); ++i)
+  {
+    for (double t = 0; t <= 1.0; t += 0.05)
+    {
+      const glm::dvec3 point = path[i] + t * (path[i + 1] - path[i]);
+      for (const glm::dvec3 &offset : { glm::dvec3(0), glm::dvec3(radius, 0, 0), glm::dvec3(0, -radius, 0),
+                                        glm::dvec3(0, 0, radius) })
+      {
+        EXPECT_NE(map.region(map.regionKey(point + offset)), nullptr);
+      }
+    }
+  }
+
+  // Far away regions are not created.
+  EXPECT_EQ(map.region(map.regionKey(glm::dvec3(-3.0, 4.0, 0))), nullptr);
+}
 }  // namespace maptests
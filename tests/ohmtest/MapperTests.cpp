@@ -0,0 +1,181 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/Mapper.h>
+#include <ohm/MappingProcess.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RegionCullProcess.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mapper
+{
+/// Tracks the number of concurrently executing @c TestProcess updates.
+struct ConcurrencyTracker
+{
+  std::atomic_int active{ 0 };
+  std::atomic_int max_active{ 0 };
+};
+
+
+/// A process which declares it reads the occupancy layer and writes the named layer, or declares nothing when
+/// @c write_layer is empty.
+class TestProcess : public ohm::MappingProcess
+{
+public:
+  TestProcess(ConcurrencyTracker &tracker, std::string write_layer)
+    : tracker_(tracker)
+    , write_layer_(std::move(write_layer))
+  {}
+
+  inline unsigned updateCount() const { return update_count_; }
+
+  bool layerDependencies(const ohm::MapLayout &layout, std::vector<int> &read_layers,
+                         std::vector<int> &write_layers) const override
+  {
+    if (write_layer_.empty())
+    {
+      return false;
+    }
+    read_layers.emplace_back(layout.occupancyLayer());
+    write_layers.emplace_back(layout.layerIndex(write_layer_.c_str()));
+    return true;
+  }
+
+  void reset() override {}
+
+  int update(ohm::OccupancyMap & /*map*/, double /*time_slice*/) override
+  {
+    const int active = ++tracker_.active;
+    int max_active = tracker_.max_active;
+    while (active > max_active && !tracker_.max_active.compare_exchange_weak(max_active, active))
+    {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));  // NOLINT(readability-magic-numbers)
+    --tracker_.active;
+    ++update_count_;
+    return ohm::kMprUpToDate;
+  }
+
+private:
+  ConcurrencyTracker &tracker_;
+  std::string write_layer_;
+  unsigned update_count_ = 0;
+};
+
+
+/// Run a concurrent mapper update with processes writing the given layers and return the maximum concurrency.
+int runConcurrent(const std::vector<std::string> &write_layers)
+{
+  ohm::OccupancyMap map(0.1);
+  ohm::MapLayout layout = map.layout();
+  ohm::addClearance(layout);
+  ohm::addVoxelMean(layout);
+  map.updateLayout(layout);
+
+  ConcurrencyTracker tracker;
+  ohm::Mapper mapper(&map);
+  mapper.setThreadCount(unsigned(write_layers.size()));
+  mapper.setConcurrent(true);
+
+  std::vector<TestProcess *> processes;
+  for (const auto &write_layer : write_layers)
+  {
+    processes.emplace_back(new TestProcess(tracker, write_layer));
+    mapper.addProcess(processes.back());
+  }
+
+  EXPECT_EQ(mapper.update(0), ohm::kMprUpToDate);
+
+  // Every process must be updated exactly once.
+  for (const TestProcess *process : processes)
+  {
+    EXPECT_EQ(process->updateCount(), 1u);
+  }
+
+  return tracker.max_active;
+}
+
+
+TEST(Mapper, Concurrent)
+{
+  // Non conflicting processes run in parallel.
+  const ohmtestutil::WorkerThreadScope worker_threads(2);
+#ifdef OHM_FEATURE_THREADS
+  const int expected_concurrency = 2;
+#else   // OHM_FEATURE_THREADS
+  const int expected_concurrency = 1;
+#endif  // OHM_FEATURE_THREADS
+  EXPECT_EQ(runConcurrent({ ohm::default_layer::clearanceLayerName(), ohm::default_layer::meanLayerName() }),
+            expected_concurrency);
+  // Processes writing the same layer must not.
+  EXPECT_EQ(runConcurrent({ ohm::default_layer::clearanceLayerName(), ohm::default_layer::clearanceLayerName() }), 1);
+  // Nor may processes which do not declare dependencies.
+  EXPECT_EQ(runConcurrent({ ohm::default_layer::clearanceLayerName(), "" }), 1);
+}
+
+
+TEST(Mapper, RegionCull)
+{
+  // Validate regions are removed by the RegionCullProcess and released on the following update.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(8));
+  const int region_count = 10;
+  for (int i = 0; i < region_count; ++i)
+  {
+    map.touchRegionTimestampByKey(glm::i16vec3(i, 0, 0), double(i), true);
+  }
+  ASSERT_EQ(map.regionCount(), size_t(region_count));
+
+  ohm::Mapper mapper(&map);
+  auto *cull = new ohm::RegionCullProcess;
+  mapper.addProcess(cull);
+
+  // Nothing to do without cull criteria.
+  EXPECT_EQ(mapper.update(0), ohm::kMprUpToDate);
+  EXPECT_EQ(map.regionCount(), size_t(region_count));
+
+  // Expire the regions touched before time 5. The removed regions are released on the next update.
+  cull->setExpiryTime(5.0);
+  EXPECT_EQ(mapper.update(0), ohm::kMprProgressing);
+  EXPECT_EQ(map.regionCount(), 5u);
+  EXPECT_EQ(map.region(glm::i16vec3(4, 0, 0)), nullptr);
+  EXPECT_NE(map.region(glm::i16vec3(5, 0, 0)), nullptr);
+  EXPECT_EQ(cull->pendingReleaseCount(), 5u);
+  EXPECT_EQ(mapper.update(0), ohm::kMprUpToDate);
+  EXPECT_EQ(cull->pendingReleaseCount(), 0u);
+  EXPECT_EQ(cull->removedCount(), 5u);
+
+  // Cull by distance from the reference position. Regions are 0.8m apart.
+  cull->clearExpiryTime();
+  cull->setCullDistance(2.0);
+  mapper.setReferencePosition(map.regionCentreGlobal(glm::i16vec3(region_count - 1, 0, 0)));
+  EXPECT_EQ(mapper.update(0), ohm::kMprProgressing);
+  EXPECT_EQ(map.regionCount(), 3u);
+
+  // Cull by extents.
+  cull->setCullDistance(0);
+  const glm::dvec3 keep_centre = map.regionCentreGlobal(glm::i16vec3(region_count - 1, 0, 0));
+  cull->setCullExtents(keep_centre - glm::dvec3(0.1), keep_centre + glm::dvec3(0.1));
+  EXPECT_EQ(mapper.update(0), ohm::kMprProgressing);
+  EXPECT_EQ(map.regionCount(), 1u);
+  EXPECT_EQ(cull->removedCount(), 9u);
+
+  cull->flush();
+  EXPECT_EQ(cull->pendingReleaseCount(), 0u);
+}
+}  // namespace mapper
@@ -0,0 +1,98 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/Metrics.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace metricstests
+{
+TEST(Metrics, Counter)
+{
+  ohm::metrics::Registry registry;
+  ohm::metrics::Counter &counter = registry.counter("test_total", "Test counter.");
+  EXPECT_EQ(&counter, &registry.counter("test_total", ""));
+  EXPECT_THROW(registry.gauge("test_total", ""), std::runtime_error);
+
+  const unsigned thread_count = 4;
+  const unsigned increments = 1000;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < thread_count; ++i)
+  {
+    threads.emplace_back([&counter]() {
+      for (unsigned j = 0; j < increments; ++j)
+      {
+        counter.add();
+      }
+    });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  EXPECT_EQ(counter.value(), thread_count * increments);
+  registry.reset();
+  EXPECT_EQ(counter.value(), 0u);
+}
+
+
+TEST(Metrics, Histogram)
+{
+  ohm::metrics::Registry registry;
+  ohm::metrics::Histogram &histogram = registry.histogram("test_seconds", "Test histogram.", { 1.0, 2.0 });
+  histogram.observe(0.5);
+  histogram.observe(1.5);
+  histogram.observe(1.5);
+  histogram.observe(3.0);
+
+  EXPECT_EQ(histogram.count(), 4u);
+  EXPECT_DOUBLE_EQ(histogram.sum(), 6.5);
+
+  std::vector<uint64_t> counts;
+  histogram.bucketCounts(counts);
+  ASSERT_EQ(counts.size(), 3u);
+  EXPECT_EQ(counts[0], 1u);
+  EXPECT_EQ(counts[1], 2u);
+  EXPECT_EQ(counts[2], 1u);
+
+  std::ostringstream str;
+  registry.writePrometheus(str);
+  const std::string text = str.str();
+  EXPECT_NE(text.find("# TYPE test_seconds histogram"), std::string::npos);
+  EXPECT_NE(text.find("test_seconds_bucket{le=\"1\"} 1"), std::string::npos);
+  EXPECT_NE(text.find("test_seconds_bucket{le=\"2\"} 3"), std::string::npos);
+  EXPECT_NE(text.find("test_seconds_bucket{le=\"+Inf\"} 4"), std::string::npos);
+  EXPECT_NE(text.find("test_seconds_count 4"), std::string::npos);
+}
+
+
+TEST(Metrics, CoreRays)
+{
+  ohm::OccupancyMap map(0.1);
+  ohm::RayMapperOccupancy mapper(&map);
+
+  const ohm::metrics::CoreMetrics &core_metrics = ohm::metrics::coreMetrics();
+  const uint64_t rays_before = core_metrics.rays_integrated.value();
+  const uint64_t calls_before = core_metrics.integrate_rays_seconds.count();
+
+  const std::vector<glm::dvec3> rays = { glm::dvec3(0.0), glm::dvec3(1.0, 0.0, 0.0),  //
+                                         glm::dvec3(0.0), glm::dvec3(0.0, 1.0, 0.0) };
+  mapper.integrateRays(rays.data(), rays.size());
+
+  EXPECT_EQ(core_metrics.rays_integrated.value(), rays_before + rays.size() / 2);
+  EXPECT_EQ(core_metrics.integrate_rays_seconds.count(), calls_before + 1);
+  EXPECT_GT(core_metrics.regions_created.value(), 0u);
+}
+}  // namespace metricstests
@@ -5,9 +5,13 @@
 // Author: Kazys Stepanas, Jason Williams
 #include "OhmTestConfig.h"
 
+#include <ohm/CovarianceEigenCache.h>
+#include <ohm/CovarianceVoxel.h>
 #include <ohm/Key.h>
 #include <ohm/NdtMap.h>
+#include <ohm/NdtRegistration.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperNdt.h>
 #include <ohm/Trace.h>
 #include <ohm/VoxelData.h>
 
@@ -15,10 +19,12 @@
 #include "ohmtestcommon/CovarianceTestUtil.h"
 #include "ohmtestcommon/OhmTestUtil.h"
 
+#include <algorithm>
 #include <chrono>
 #include <random>
 #include <unordered_map>
 
+#include <glm/glm.hpp>
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/norm.hpp>
@@ -467,4 +473,430 @@ TEST(Ndt, MissSpherical)
   testNdtMiss(sensor, samples, voxel_resolution, sensor_noise, glm::dvec3(-0.5 * voxel_resolution), rays,
               expected_prob_and_tolerance);
 }
+
+TEST(Ndt, HitBatch)
+{
+  // Validate calculateHitWithCovarianceBatch() matches calculateHitWithCovariance() exactly.
+  uint32_t seed = 1153297050u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform_cov(-0.1f, 0.1f);
+  std::uniform_int_distribution<unsigned> point_count_rand(0, 20);
+  const float voxel_resolution = 1.0f;
+  const float hit_value = ohm::probabilityToValue(0.7f);
+  const float reinitialise_threshold = ohm::probabilityToValue(0.2f);
+  const unsigned reinitialise_sample_count = 10;
+
+  for (int iteration = 0; iteration < 100; ++iteration)
+  {
+    ohm::CovarianceHitBatch batch;
+    std::vector<ohm::CovarianceVoxel> expected_cov(ohm::kCovarianceBatchWidth);
+    std::vector<float> expected_value(ohm::kCovarianceBatchWidth);
+    std::vector<bool> expected_reset(ohm::kCovarianceBatchWidth);
+    for (unsigned lane = 0; lane < ohm::kCovarianceBatchWidth; ++lane)
+    {
+      ohm::CovarianceVoxel cov;
+      ohm::initialiseCovariance(&cov, voxel_resolution);
+      for (float &cov_value : cov.trianglar_covariance)
+      {
+        cov_value += uniform_cov(rng);
+      }
+      // Cover uncertain and reinitialising voxels.
+      const float voxel_value = (lane == 0) ? ohm::unobservedOccupancyValue() :
+                                              ohm::probabilityToValue(float(uniform(rng)));
+      const glm::dvec3 sample(uniform(rng), uniform(rng), uniform(rng));
+      const glm::dvec3 mean(uniform(rng), uniform(rng), uniform(rng));
+      const unsigned point_count = point_count_rand(rng);
+
+      batch.add(cov, voxel_value, sample, mean, point_count);
+
+      expected_value[lane] = voxel_value;
+      expected_reset[lane] =
+        ohm::calculateHitWithCovariance(&cov, &expected_value[lane], sample, mean, point_count, hit_value,
+                                        ohm::unobservedOccupancyValue(), voxel_resolution, reinitialise_threshold,
+                                        reinitialise_sample_count);
+      expected_cov[lane] = cov;
+    }
+
+    ohm::calculateHitWithCovarianceBatch(batch, hit_value, ohm::unobservedOccupancyValue(), voxel_resolution,
+                                         reinitialise_threshold, reinitialise_sample_count);
+
+    for (unsigned lane = 0; lane < ohm::kCovarianceBatchWidth; ++lane)
+    {
+      ohm::CovarianceVoxel cov;
+      batch.getCovariance(lane, &cov);
+      for (int i = 0; i < 6; ++i)
+      {
+        EXPECT_EQ(cov.trianglar_covariance[i], expected_cov[lane].trianglar_covariance[i]);
+      }
+      EXPECT_EQ(batch.voxel_value[lane], expected_value[lane]);
+      EXPECT_EQ(batch.reset_mean[lane], expected_reset[lane]);
+    }
+  }
+}
+
+TEST(Ndt, HitBatchSinglePrecision)
+{
+  // Validate the single precision calculateHitWithCovarianceBatch() against the double precision
+  // calculateHitWithCovariance() .
+  uint32_t seed = 1153297050u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform_cov(-0.1f, 0.1f);
+  std::uniform_int_distribution<unsigned> point_count_rand(0, 20);
+  const float voxel_resolution = 1.0f;
+  const float hit_value = ohm::probabilityToValue(0.7f);
+  const float reinitialise_threshold = ohm::probabilityToValue(0.2f);
+  const unsigned reinitialise_sample_count = 10;
+  const float tolerance = 1e-5f;
+
+  for (int iteration = 0; iteration < 100; ++iteration)
+  {
+    ohm::CovarianceHitBatch batch;
+    std::vector<ohm::CovarianceVoxel> expected_cov(ohm::kCovarianceBatchWidth);
+    std::vector<float> expected_value(ohm::kCovarianceBatchWidth);
+    std::vector<bool> expected_reset(ohm::kCovarianceBatchWidth);
+    for (unsigned lane = 0; lane < ohm::kCovarianceBatchWidth; ++lane)
+    {
+      ohm::CovarianceVoxel cov;
+      ohm::initialiseCovariance(&cov, voxel_resolution);
+      for (float &cov_value : cov.trianglar_covariance)
+      {
+        cov_value += uniform_cov(rng);
+      }
+      const float voxel_value = (lane == 0) ? ohm::unobservedOccupancyValue() :
+                                              ohm::probabilityToValue(float(uniform(rng)));
+      // Offset the points from the origin to validate precision is retained in global coordinates.
+      const glm::dvec3 offset(1000.0, -2000.0, 50.0);
+      const glm::dvec3 sample = offset + glm::dvec3(uniform(rng), uniform(rng), uniform(rng));
+      const glm::dvec3 mean = offset + glm::dvec3(uniform(rng), uniform(rng), uniform(rng));
+      const unsigned point_count = point_count_rand(rng);
+
+      batch.add(cov, voxel_value, sample, mean, point_count);
+
+      expected_value[lane] = voxel_value;
+      expected_reset[lane] =
+        ohm::calculateHitWithCovariance(&cov, &expected_value[lane], sample, mean, point_count, hit_value,
+                                        ohm::unobservedOccupancyValue(), voxel_resolution, reinitialise_threshold,
+                                        reinitialise_sample_count);
+      expected_cov[lane] = cov;
+    }
+
+    ohm::calculateHitWithCovarianceBatch(batch, hit_value, ohm::unobservedOccupancyValue(), voxel_resolution,
+                                         reinitialise_threshold, reinitialise_sample_count, true);
+
+    for (unsigned lane = 0; lane < ohm::kCovarianceBatchWidth; ++lane)
+    {
+      ohm::CovarianceVoxel cov;
+      batch.getCovariance(lane, &cov);
+      for (int i = 0; i < 6; ++i)
+      {
+        EXPECT_NEAR(cov.trianglar_covariance[i], expected_cov[lane].trianglar_covariance[i], tolerance);
+      }
+      EXPECT_EQ(batch.voxel_value[lane], expected_value[lane]);
+      EXPECT_EQ(batch.reset_mean[lane], expected_reset[lane]);
+    }
+  }
+}
+
+TEST(Ndt, HitBatchRayMapper)
+{
+  // Integrate many rays with repeated sample voxels at once, using batched covariance updates, and one ray at a time,
+  // where no two sample voxels can share a batch. The results must match exactly.
+  uint32_t seed = 1153297050u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<double> uniform(-2.0, 2.0);
+  const size_t ray_count = 4000;
+  const double resolution = 0.5;
+
+  std::vector<glm::dvec3> rays;
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(glm::dvec3(uniform(rng), uniform(rng), uniform(rng)) * 4.0);
+    rays.emplace_back(glm::dvec3(uniform(rng), uniform(rng), uniform(rng)));
+  }
+
+  ohm::OccupancyMap batch_map(resolution, ohm::MapFlag::kVoxelMean);
+  ohm::NdtMap batch_ndt(&batch_map, true);
+  ohm::RayMapperNdt batch_mapper(&batch_ndt);
+  batch_mapper.integrateRays(rays.data(), rays.size());
+
+  ohm::OccupancyMap ray_map(resolution, ohm::MapFlag::kVoxelMean);
+  ohm::NdtMap ray_ndt(&ray_map, true);
+  ohm::RayMapperNdt ray_mapper(&ray_ndt);
+  for (size_t i = 0; i < rays.size(); i += 2)
+  {
+    ray_mapper.integrateRays(rays.data() + i, 2);
+  }
+
+  // Compare the sample voxels. Most sample voxels are also traversed by other rays.
+  ohm::Voxel<const float> batch_occupancy(&batch_map, batch_map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::VoxelMean> batch_mean(&batch_map, batch_map.layout().meanLayer());
+  ohm::Voxel<const ohm::CovarianceVoxel> batch_cov(&batch_map, batch_map.layout().covarianceLayer());
+  ohm::Voxel<const float> ray_occupancy(&ray_map, ray_map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::VoxelMean> ray_mean(&ray_map, ray_map.layout().meanLayer());
+  ohm::Voxel<const ohm::CovarianceVoxel> ray_cov(&ray_map, ray_map.layout().covarianceLayer());
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    const ohm::Key key = batch_map.voxelKey(rays[i]);
+    ohm::setVoxelKey(key, batch_occupancy, batch_mean, batch_cov);
+    ohm::setVoxelKey(key, ray_occupancy, ray_mean, ray_cov);
+    ASSERT_TRUE(batch_occupancy.isValid() && batch_mean.isValid() && batch_cov.isValid());
+    ASSERT_TRUE(ray_occupancy.isValid() && ray_mean.isValid() && ray_cov.isValid());
+
+    EXPECT_EQ(batch_occupancy.data(), ray_occupancy.data());
+    const ohm::VoxelMean batch_mean_data = batch_mean.data();
+    const ohm::VoxelMean ray_mean_data = ray_mean.data();
+    EXPECT_EQ(batch_mean_data.coord, ray_mean_data.coord);
+    EXPECT_EQ(batch_mean_data.count, ray_mean_data.count);
+    const ohm::CovarianceVoxel batch_cov_data = batch_cov.data();
+    const ohm::CovarianceVoxel ray_cov_data = ray_cov.data();
+    for (int j = 0; j < 6; ++j)
+    {
+      EXPECT_EQ(batch_cov_data.trianglar_covariance[j], ray_cov_data.trianglar_covariance[j]);
+    }
+  }
+}
+
+/// Build an NDT map of a box shaped room about the origin and return the sample points.
+std::vector<glm::dvec3> buildNdtRoom(ohm::NdtMap &ndt)
+{
+  uint32_t seed = 2718281828u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<double> uniform(-2.8, 2.8);
+  std::normal_distribution<double> noise(0.0, 0.02);
+  std::uniform_int_distribution<int> face(0, 4);
+  const size_t sample_count = 40000;
+
+  std::vector<glm::dvec3> samples;
+  std::vector<glm::dvec3> rays;
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    glm::dvec3 sample(uniform(rng), uniform(rng), uniform(rng));
+    const int axis = face(rng);
+    // Walls at +/- 3 along X and Y and a floor at Z = -1.5.
+    switch (axis)
+    {
+    case 0:
+      sample.x = 3.0;
+      break;
+    case 1:
+      sample.x = -3.0;
+      break;
+    case 2:
+      sample.y = 3.0;
+      break;
+    case 3:
+      sample.y = -3.0;
+      break;
+    default:
+      sample.z = -1.5;
+      break;
+    }
+    sample.z = std::max(sample.z, -1.5);
+    sample += glm::dvec3(noise(rng), noise(rng), noise(rng));
+    samples.emplace_back(sample);
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(sample);
+  }
+
+  ohm::RayMapperNdt mapper(&ndt);
+  mapper.integrateRays(rays.data(), rays.size());
+  return samples;
+}
+
+
+TEST(Ndt, RegistrationGradient)
+{
+  // Validate the analytic gradient against central differences of the score.
+  ohm::OccupancyMap map(0.5, ohm::MapFlag::kVoxelMean);
+  ohm::NdtMap ndt(&map, true);
+  const std::vector<glm::dvec3> samples = buildNdtRoom(ndt);
+  const std::vector<glm::dvec3> scan(samples.begin(), samples.begin() + 2000);
+
+  ohm::NdtRegistration registration(ndt);
+  const ohm::NdtPose pose = { 0.05, -0.04, 0.03, 0.01, -0.02, 0.03 };
+  const ohm::NdtScore score = registration.evaluate(scan.data(), scan.size(), pose);
+  ASSERT_GT(score.match_count, 0u);
+  EXPECT_GT(registration.cachedRegionCount(), 0u);
+
+  const double delta = 1e-6;
+  for (int i = 0; i < 6; ++i)
+  {
+    ohm::NdtPose pose_plus = pose;
+    ohm::NdtPose pose_minus = pose;
+    pose_plus[i] += delta;
+    pose_minus[i] -= delta;
+    const double score_plus = registration.evaluate(scan.data(), scan.size(), pose_plus, false).score;
+    const double score_minus = registration.evaluate(scan.data(), scan.size(), pose_minus, false).score;
+    const double numeric = (score_plus - score_minus) / (2.0 * delta);
+    EXPECT_NEAR(score.gradient[i], numeric, 1e-3 * std::max(1.0, std::abs(numeric)));
+  }
+
+  // Hessian must be symmetric.
+  for (int i = 0; i < 6; ++i)
+  {
+    for (int j = 0; j < 6; ++j)
+    {
+      EXPECT_EQ(score.hessian[i * 6 + j], score.hessian[j * 6 + i]);
+    }
+  }
+
+  // Threaded and serial evaluation must match.
+  ohm::NdtRegistrationParams params = registration.params();
+  params.use_threads = false;
+  ohm::NdtRegistration serial_registration(ndt, params);
+  const ohm::NdtScore serial_score = serial_registration.evaluate(scan.data(), scan.size(), pose);
+  EXPECT_EQ(score.score, serial_score.score);
+  EXPECT_EQ(score.match_count, serial_score.match_count);
+}
+
+
+TEST(Ndt, RegistrationAlign)
+{
+  ohm::OccupancyMap map(0.5, ohm::MapFlag::kVoxelMean);
+  ohm::NdtMap ndt(&map, true);
+  const std::vector<glm::dvec3> samples = buildNdtRoom(ndt);
+
+  // Express a subset of the samples in a sensor frame offset from the map frame, then recover the offset.
+  const ohm::NdtPose expected_pose = { 0.15, -0.1, 0.05, 0.0, 0.0, glm::radians(3.0) };
+  const glm::dmat4 expected_transform = ohm::NdtRegistration::poseToTransform(expected_pose);
+  const glm::dmat4 inverse_transform = glm::inverse(expected_transform);
+  std::vector<glm::dvec3> scan;
+  for (size_t i = 0; i < samples.size(); i += 10)
+  {
+    scan.emplace_back(glm::dvec3(inverse_transform * glm::dvec4(samples[i], 1.0)));
+  }
+
+  const ohm::NdtPose round_trip = ohm::NdtRegistration::transformToPose(expected_transform);
+  for (int i = 0; i < 6; ++i)
+  {
+    EXPECT_NEAR(round_trip[i], expected_pose[i], 1e-9);
+  }
+
+  ohm::NdtRegistration registration(ndt);
+  const ohm::NdtAlignResult result = registration.align(scan.data(), scan.size(), glm::dmat4(1.0));
+  EXPECT_GT(result.iterations, 0u);
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_NEAR(result.pose[i], expected_pose[i], 0.02);
+  }
+  for (int i = 3; i < 6; ++i)
+  {
+    EXPECT_NEAR(result.pose[i], expected_pose[i], glm::radians(0.5));
+  }
+}
+
+
+TEST(Ndt, EigenBatch)
+{
+  // Validate covarianceEigenDecompositionBatch() against covarianceEigenDecomposition() .
+  uint32_t seed = 1153297050u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<float> uniform_cov(-0.1f, 0.1f);
+  const float voxel_resolution = 1.0f;
+  const double tolerance = 1e-6;
+
+  for (int iteration = 0; iteration < 100; ++iteration)
+  {
+    ohm::CovarianceEigenBatch batch;
+    std::vector<ohm::CovarianceVoxel> covariances(ohm::kCovarianceBatchWidth);
+    for (unsigned lane = 0; lane < ohm::kCovarianceBatchWidth; ++lane)
+    {
+      ohm::CovarianceVoxel &cov = covariances[lane];
+      ohm::initialiseCovariance(&cov, voxel_resolution);
+      // Cover zero and isotropic covariance in the first lanes.
+      for (float &cov_value : cov.trianglar_covariance)
+      {
+        cov_value = (lane == 0) ? 0.0f : ((lane == 1) ? cov_value : cov_value + uniform_cov(rng));
+      }
+      batch.add(cov);
+    }
+
+    ohm::covarianceEigenDecompositionBatch(batch);
+
+    for (unsigned lane = 0; lane < ohm::kCovarianceBatchWidth; ++lane)
+    {
+      glm::dmat3 eigenvectors;
+      glm::dvec3 eigenvalues;
+      batch.getDecomposition(lane, &eigenvectors, &eigenvalues);
+
+      glm::dmat3 expected_eigenvectors;
+      glm::dvec3 expected_eigenvalues;
+      ohm::covarianceEigenDecomposition(&covariances[lane], &expected_eigenvectors, &expected_eigenvalues);
+      std::sort(glm::value_ptr(expected_eigenvalues), glm::value_ptr(expected_eigenvalues) + 3);
+
+      // The eigenvectors form a rotation matrix.
+      EXPECT_NEAR(glm::determinant(eigenvectors), 1.0, tolerance);
+      const glm::dmat3 covariance = ohm::covarianceMatrix(&covariances[lane]);
+      for (int i = 0; i < 3; ++i)
+      {
+        EXPECT_NEAR(eigenvalues[i], expected_eigenvalues[i], tolerance);
+        EXPECT_NEAR(glm::length(eigenvectors[i]), 1.0, tolerance);
+        // A v = lambda v
+        const glm::dvec3 residual = covariance * eigenvectors[i] - eigenvalues[i] * eigenvectors[i];
+        EXPECT_NEAR(glm::length(residual), 0.0, tolerance);
+      }
+      if (lane < 2)
+      {
+        EXPECT_EQ(eigenvectors, glm::dmat3(1.0));
+      }
+    }
+  }
+}
+
+
+TEST(Ndt, EigenCache)
+{
+  ohm::OccupancyMap map(0.5, ohm::MapFlag::kVoxelMean);
+  ohm::NdtMap ndt(&map, true);
+  const std::vector<glm::dvec3> samples = buildNdtRoom(ndt);
+
+  ohm::CovarianceEigenCache cache(map);
+  ASSERT_TRUE(cache.isValid());
+  EXPECT_EQ(cache.update(), map.regionCount());
+  EXPECT_EQ(cache.regionCount(), map.regionCount());
+  // Nothing has changed.
+  EXPECT_EQ(cache.update(), 0u);
+
+  ohm::Voxel<const ohm::CovarianceVoxel> cov_voxel(&map, map.layout().covarianceLayer());
+  for (size_t i = 0; i < samples.size(); i += 100)
+  {
+    const ohm::Key key = map.voxelKey(samples[i]);
+    ohm::CovarianceEigen eigen;
+    ASSERT_TRUE(cache.currentVoxel(key, &eigen));
+
+    cov_voxel.setKey(key);
+    ohm::CovarianceVoxel cov;
+    cov_voxel.read(&cov);
+    glm::dmat3 expected_eigenvectors;
+    glm::dvec3 expected_eigenvalues;
+    ohm::covarianceEigenDecomposition(&cov, &expected_eigenvectors, &expected_eigenvalues);
+    std::sort(glm::value_ptr(expected_eigenvalues), glm::value_ptr(expected_eigenvalues) + 3);
+    for (int j = 0; j < 3; ++j)
+    {
+      EXPECT_NEAR(eigen.values[j], expected_eigenvalues[j], 1e-5 * expected_eigenvalues[2] + 1e-9);
+    }
+
+    // Compare normals where the smallest eigenvalue is distinct.
+    if (expected_eigenvalues[0] < 0.5 * expected_eigenvalues[1])
+    {
+      glm::dvec3 expected_normal;
+      ohm::covarianceEstimatePrimaryNormal(&cov, &expected_normal);
+      EXPECT_NEAR(std::abs(glm::dot(eigen.primaryNormal(), expected_normal)), 1.0, 1e-4);
+    }
+  }
+  cov_voxel.reset();
+
+  // Modify one voxel. Only its region is stale.
+  const ohm::Key key = map.voxelKey(samples.front());
+  ohm::integrateNdtHit(ndt, key, glm::dvec3(0.0), samples.front());
+  ohm::CovarianceEigen eigen;
+  EXPECT_FALSE(cache.currentVoxel(key, &eigen));
+  EXPECT_TRUE(cache.voxel(key, &eigen));
+  EXPECT_TRUE(cache.currentVoxel(key, &eigen));
+  EXPECT_EQ(cache.update(), 0u);
+  ohm::integrateNdtHit(ndt, key, glm::dvec3(0.0), samples.front());
+  EXPECT_EQ(cache.update(), 1u);
+}
 }  // namespace ndttests
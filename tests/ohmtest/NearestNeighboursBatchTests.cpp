@@ -0,0 +1,117 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapFlag.h>
+#include <ohm/NearestNeighbours.h>
+#include <ohm/NearestNeighboursBatch.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace nearestneighboursbatchtests
+{
+void validateResults(ohm::OccupancyMap &map, const ohm::NearestNeighboursBatch &batch,
+                     const std::vector<glm::dvec3> &points)
+{
+  ASSERT_EQ(batch.numberOfResults(), points.size());
+  ohm::NearestNeighbours single(map, glm::dvec3(0), batch.searchRadius(), batch.queryFlags());
+  single.setUseThreads(false);
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    single.setNearPoint(points[i]);
+    ASSERT_TRUE(single.execute());
+    ASSERT_EQ(batch.resultCounts()[i], single.numberOfResults()) << i;
+
+    const size_t offset = batch.resultIndices()[i];
+    if (batch.queryFlags() & ohm::kQfNearestResult)
+    {
+      // Ties may resolve to different voxels. Compare the range only.
+      if (single.numberOfResults())
+      {
+        EXPECT_FLOAT_EQ(float(batch.ranges()[offset]), float(single.ranges()[0])) << i;
+      }
+      continue;
+    }
+
+    std::vector<ohm::Key> expected(single.intersectedVoxels(), single.intersectedVoxels() + single.numberOfResults());
+    std::vector<ohm::Key> actual(batch.intersectedVoxels() + offset,
+                                 batch.intersectedVoxels() + offset + batch.resultCounts()[i]);
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    ASSERT_EQ(actual, expected) << i;
+  }
+}
+
+
+void testBatch(ohm::MapFlag map_flags)
+{
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(16), map_flags);
+
+  // Scatter occupied and free voxels over a few regions.
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-2.0, 2.0);
+  for (unsigned i = 0; i < 4000; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    const ohm::Key key = map.voxelKey(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+    if (i % 3)
+    {
+      ohm::integrateHit(map, key);
+    }
+    else
+    {
+      ohm::integrateMiss(map, key);
+    }
+  }
+
+  // Use enough query points for several evaluation blocks, including points outside the populated regions.
+  std::uniform_real_distribution<double> rand_query(-3.0, 3.0);
+  std::vector<glm::dvec3> points;
+  for (unsigned i = 0; i < 600; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    points.emplace_back(glm::dvec3(rand_query(rand_engine), rand_query(rand_engine), rand_query(rand_engine)));
+  }
+
+  const float search_radius = 0.35f;  // NOLINT(readability-magic-numbers)
+  for (unsigned flags : { 0u, unsigned(ohm::kQfNearestResult), unsigned(ohm::kQfUnknownAsOccupied) })
+  {
+    for (bool use_threads : { false, true })
+    {
+      ohm::NearestNeighboursBatch batch(map, search_radius, flags);
+      batch.setUseThreads(use_threads);
+      batch.setNearPoints(points.data(), points.size());
+      ASSERT_EQ(batch.nearPointCount(), points.size());
+      ASSERT_TRUE(batch.execute());
+      validateResults(map, batch, points);
+
+      ASSERT_TRUE(batch.executeAsync());
+      ASSERT_TRUE(batch.wait());
+      validateResults(map, batch, points);
+    }
+  }
+}
+
+
+TEST(NearestNeighboursBatch, Cpu)
+{
+  testBatch(ohm::MapFlag::kNone);
+}
+
+
+TEST(NearestNeighboursBatch, Summary)
+{
+  testBatch(ohm::MapFlag::kOccupancySummary | ohm::MapFlag::kVoxelOrderMorton);
+}
+}  // namespace nearestneighboursbatchtests
@@ -0,0 +1,159 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapFlag.h>
+#include <ohm/MapMerge.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/OccupancyState.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <vector>
+
+namespace occupancystatetests
+{
+/// Count the regions of @p map where the occupancy state layer is stale.
+size_t countStaleRegions(const ohm::OccupancyMap &map)
+{
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int state_layer = map.layout().layerIndex(ohm::default_layer::occupancyStateLayerName());
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  size_t stale_count = 0;
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    stale_count += ohm::occupancyStateStale(*chunk, occupancy_layer, state_layer) ? 1u : 0u;
+  }
+  return stale_count;
+}
+
+
+/// Validate the occupancy state layer against the occupancy layer.
+void validateState(const ohm::OccupancyMap &map)
+{
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  size_t free_count = 0;
+  size_t occupied_count = 0;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(iter);
+    const ohm::OccupancyType expected_type = ohm::occupancyType(occupancy);
+    EXPECT_EQ(ohm::occupancyState(map, *iter), expected_type);
+    free_count += (expected_type == ohm::kFree) ? 1 : 0;
+    occupied_count += (expected_type == ohm::kOccupied) ? 1 : 0;
+  }
+  occupancy.reset();
+
+  size_t state_free_count = 0;
+  size_t state_occupied_count = 0;
+  ASSERT_TRUE(ohm::countOccupancyStates(map, &state_free_count, &state_occupied_count));
+  EXPECT_GT(free_count, 0u);
+  EXPECT_GT(occupied_count, 0u);
+  EXPECT_EQ(state_free_count, free_count);
+  EXPECT_EQ(state_occupied_count, occupied_count);
+}
+
+
+TEST(OccupancyState, Pack)
+{
+  uint16_t packed = 0;
+  glm::u8vec3 local_key;
+  for (local_key.z = 0; local_key.z < 2; ++local_key.z)
+  {
+    for (local_key.y = 0; local_key.y < 2; ++local_key.y)
+    {
+      for (local_key.x = 0; local_key.x < 2; ++local_key.x)
+      {
+        const unsigned state = (local_key.x + local_key.y + local_key.z) % 3u;
+        packed = ohm::packOccupancyState(packed, local_key, state);
+        EXPECT_EQ(ohm::unpackOccupancyState(packed, local_key), state);
+      }
+    }
+  }
+
+  // Overwrite a state without disturbing its neighbours.
+  packed = ohm::packOccupancyState(packed, glm::u8vec3(1, 1, 1), ohm::kOsFree);
+  EXPECT_EQ(ohm::unpackOccupancyState(packed, glm::u8vec3(1, 1, 1)), ohm::kOsFree);
+  EXPECT_EQ(ohm::unpackOccupancyState(packed, glm::u8vec3(0, 1, 1)), 2u);
+  EXPECT_EQ(ohm::popCount16(0xFFFFu), 16u);
+  EXPECT_EQ(ohm::popCount16(0x8421u), 4u);
+}
+
+
+TEST(OccupancyState, RayMapper)
+{
+  // Validate incremental maintenance of the state layer for serial and threaded ray integration.
+  for (bool use_threads : { false, true })
+  {
+    ohm::OccupancyMap map(0.25, glm::u8vec3(8), ohm::MapFlag::kDefault | ohm::MapFlag::kOccupancyState);
+    ASSERT_GE(map.layout().layerIndex(ohm::default_layer::occupancyStateLayerName()), 0);
+    ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 2000u, 0x1234u, use_threads);
+    EXPECT_EQ(countStaleRegions(map), 0u);
+    validateState(map);
+  }
+}
+
+
+TEST(OccupancyState, Update)
+{
+  // Build a map without the state layer, then add it and resynchronise after a threshold change.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 2000u, 0x1234u);
+  size_t free_count = 0;
+  EXPECT_FALSE(ohm::countOccupancyStates(map, &free_count, nullptr));
+  EXPECT_EQ(ohm::occupancyState(map, map.voxelKey(glm::dvec3(0.0))), ohm::kNull);
+
+  ASSERT_TRUE(ohm::updateOccupancyState(map));
+  validateState(map);
+
+  map.setOccupancyThresholdProbability(0.8f);
+  ASSERT_TRUE(ohm::updateOccupancyState(map));
+  validateState(map);
+
+  // Odd region dimensions are not supported.
+  ohm::OccupancyMap odd_map(0.25, glm::u8vec3(7));
+  EXPECT_FALSE(ohm::updateOccupancyState(odd_map));
+}
+
+
+TEST(OccupancyState, Stale)
+{
+  // Occupancy updates which do not maintain the state layer must leave it stale rather than inconsistent.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8), ohm::MapFlag::kDefault | ohm::MapFlag::kOccupancyState);
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 2000u, 0x1234u);
+  ASSERT_EQ(countStaleRegions(map), 0u);
+
+  ohm::OccupancyMap src_map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(src_map, glm::dvec3(1.0), 5.0, 2000u, 0x4321u);
+  ASSERT_TRUE(ohm::mergeMap(map, src_map));
+  EXPECT_GT(countStaleRegions(map), 0u);
+  // Queries fall back to the occupancy layer in stale regions.
+  validateState(map);
+
+  // Ray integration into stale regions must not mark them as current.
+  const size_t stale_count = countStaleRegions(map);
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 100u, 0x5678u);
+  EXPECT_GE(countStaleRegions(map), stale_count);
+
+  ASSERT_TRUE(ohm::updateOccupancyState(map));
+  EXPECT_EQ(countStaleRegions(map), 0u);
+  validateState(map);
+
+  // A threshold change invalidates the whole layer.
+  map.setOccupancyThresholdProbability(0.8f);
+  EXPECT_GT(countStaleRegions(map), 0u);
+  validateState(map);
+  ASSERT_TRUE(ohm::updateOccupancyState(map));
+  EXPECT_EQ(countStaleRegions(map), 0u);
+  validateState(map);
+}
+}  // namespace occupancystatetests
@@ -0,0 +1,166 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapChunk.h>
+#include <ohm/MapProbability.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/OccupancyTransform.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/RegionCullProcess.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace occupancytransformtests
+{
+TEST(OccupancyTransform, Decay)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+  ohm::OccupancyMap reference_map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(reference_map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+
+  const float decay_factor = 0.5f;
+  ohm::decayOccupancy(map, decay_factor);
+
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  ohm::Voxel<const float> reference(&reference_map, reference_map.layout().occupancyLayer());
+  size_t observed_count = 0;
+  for (auto iter = reference_map.begin(); iter != reference_map.end(); ++iter)
+  {
+    reference.setKey(iter);
+    occupancy.setKey(*iter);
+    ASSERT_TRUE(occupancy.isValid());
+    if (ohm::isUnobserved(reference))
+    {
+      EXPECT_TRUE(ohm::isUnobserved(occupancy));
+    }
+    else
+    {
+      EXPECT_FLOAT_EQ(occupancy.data(), reference.data() * decay_factor);
+      ++observed_count;
+    }
+  }
+  EXPECT_GT(observed_count, 0u);
+}
+
+
+TEST(OccupancyTransform, LazyDecay)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(8));
+  map.addTouchTimeLayer();
+  const double decay_time = 1.0;
+  map.setOccupancyDecayTime(decay_time);
+
+  const glm::dvec3 ray[] = { glm::dvec3(0.05), glm::dvec3(0.55, 0.05, 0.05) };
+  const ohm::Key hit_key = map.voxelKey(ray[1]);
+  const ohm::Key miss_key = map.voxelKey(glm::dvec3(0.25, 0.05, 0.05));
+  ohm::RayMapperOccupancy mapper(&map);
+
+  double timestamp = 10.0;
+  mapper.integrateRays(ray, 2, nullptr, &timestamp, ohm::kRfDefault);
+  const float hit_value = ohm::Voxel<const float>(&map, map.layout().occupancyLayer(), hit_key).data();
+  const float miss_value = ohm::Voxel<const float>(&map, map.layout().occupancyLayer(), miss_key).data();
+  ASSERT_NEAR(hit_value, map.hitValue(), 1e-5f);
+  ASSERT_NEAR(miss_value, map.missValue(), 1e-5f);
+
+  // Reads decay without modifying the map.
+  EXPECT_NEAR(ohm::decayedOccupancy(map, hit_key, timestamp + decay_time), hit_value * std::exp(-1.0f), 1e-4f);
+  EXPECT_NEAR(ohm::decayedOccupancy(map, miss_key, timestamp + decay_time), miss_value * std::exp(-1.0f), 1e-4f);
+  EXPECT_EQ(ohm::Voxel<const float>(&map, map.layout().occupancyLayer(), hit_key).data(), hit_value);
+
+  // Updates decay the existing value before adjusting it.
+  timestamp += 2.0 * decay_time;
+  mapper.integrateRays(ray, 2, nullptr, &timestamp, ohm::kRfDefault);
+  EXPECT_NEAR(ohm::Voxel<const float>(&map, map.layout().occupancyLayer(), hit_key).data(),
+              hit_value * std::exp(-2.0f) + map.hitValue(), 1e-4f);
+  EXPECT_NEAR(ohm::Voxel<const float>(&map, map.layout().occupancyLayer(), miss_key).data(),
+              miss_value * std::exp(-2.0f) + map.missValue(), 1e-4f);
+  // The update time is now the touch time for both hits and misses.
+  EXPECT_NEAR(ohm::decayedOccupancy(map, miss_key, timestamp),
+              ohm::Voxel<const float>(&map, map.layout().occupancyLayer(), miss_key).data(), 1e-3f);
+
+  // Compact fully decayed regions in the background.
+  ohm::RegionCullProcess cull;
+  const size_t region_count = map.regionCount();
+  ASSERT_GT(region_count, 0u);
+  cull.setDecayCullTime(timestamp + decay_time);
+  EXPECT_EQ(cull.update(map, 0), ohm::kMprUpToDate);
+  EXPECT_EQ(map.regionCount(), region_count);
+  cull.setDecayCullTime(timestamp + 20.0 * decay_time);
+  EXPECT_EQ(cull.update(map, 0), ohm::kMprProgressing);
+  EXPECT_EQ(map.regionCount(), 0u);
+  EXPECT_EQ(cull.removedCount(), region_count);
+
+  // Saturation locked voxels never decay.
+  ohm::OccupancyMap saturated_map(0.1, glm::u8vec3(8));
+  saturated_map.addTouchTimeLayer();
+  saturated_map.setOccupancyDecayTime(decay_time);
+  saturated_map.setMaxVoxelValue(saturated_map.hitValue());
+  saturated_map.setSaturateAtMaxValue(true);
+  ohm::RayMapperOccupancy(&saturated_map).integrateRays(ray, 2, nullptr, &timestamp, ohm::kRfDefault);
+  EXPECT_EQ(ohm::decayedOccupancy(saturated_map, hit_key, timestamp + 20.0 * decay_time),
+            saturated_map.hitValue());
+  const ohm::MapChunk *chunk = saturated_map.region(hit_key.regionKey());
+  ASSERT_NE(chunk, nullptr);
+  EXPECT_FALSE(ohm::isRegionDecayed(saturated_map, *chunk, timestamp + 20.0 * decay_time, 0.1f));
+}
+
+
+TEST(OccupancyTransform, Clamp)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+
+  const float min_value = 0.5f * map.minVoxelValue();
+  const float max_value = 0.5f * map.maxVoxelValue();
+  map.setMinVoxelValue(min_value);
+  map.setMaxVoxelValue(max_value);
+  ohm::clampOccupancy(map);
+
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(iter);
+    if (!ohm::isUnobserved(occupancy))
+    {
+      EXPECT_GE(occupancy.data(), min_value);
+      EXPECT_LE(occupancy.data(), max_value);
+    }
+  }
+}
+
+
+TEST(OccupancyTransform, Threshold)
+{
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+
+  ASSERT_TRUE(ohm::thresholdOccupancy(map, map.occupancyThresholdProbability()));
+  ASSERT_GE(map.layout().layerIndex(ohm::default_layer::occupancyMaskLayerName()), 0);
+
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  size_t occupied_count = 0;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(iter);
+    const bool occupied = ohm::isOccupied(occupancy);
+    EXPECT_EQ(ohm::isMaskOccupied(map, *iter), occupied) << *iter;
+    occupied_count += occupied ? 1 : 0;
+  }
+  EXPECT_GT(occupied_count, 0u);
+
+  // Odd region dimensions are not supported.
+  ohm::OccupancyMap odd_map(0.25, glm::u8vec3(7));
+  EXPECT_FALSE(ohm::thresholdOccupancy(odd_map, odd_map.occupancyThresholdProbability()));
+}
+}  // namespace occupancytransformtests
@@ -0,0 +1,91 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/Key.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmtools/OhmOctomap.h>
+
+#include <octomap/OcTree.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+namespace octomaptests
+{
+TEST(Octomap, RoundTrip)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.05), 3.0, 1000u, 0x1234u);
+
+  // Add a uniform block, aligned to the octree, which collapses into a coarse octree leaf.
+  {
+    ohm::Voxel<float> occupancy(&map, map.layout().occupancyLayer());
+    for (int z = 0; z < 8; ++z)
+    {
+      for (int y = 0; y < 8; ++y)
+      {
+        for (int x = 0; x < 8; ++x)
+        {
+          occupancy.setKey(map.voxelKey(glm::dvec3(6.45 + x * 0.1, 6.45 + y * 0.1, 6.45 + z * 0.1)));
+          occupancy.write(map.maxVoxelValue());
+        }
+      }
+    }
+  }
+
+  octomap::OcTree tree(0.1);
+  const size_t exported_count = ohmtools::exportOctomap(map, tree);
+  EXPECT_GT(exported_count, 0u);
+  EXPECT_LT(tree.getNumLeafNodes(), exported_count);
+
+  // Validate against the tree.
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  size_t observed_count = 0;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(*iter);
+    const glm::dvec3 centre = map.voxelCentreGlobal(*iter);
+    const octomap::OcTreeNode *node = tree.search(centre.x, centre.y, centre.z);
+    if (occupancy.data() == ohm::unobservedOccupancyValue())
+    {
+      EXPECT_EQ(node, nullptr);
+      continue;
+    }
+    ASSERT_NE(node, nullptr);
+    EXPECT_EQ(node->getLogOdds(), occupancy.data());
+    ++observed_count;
+  }
+  EXPECT_EQ(observed_count, exported_count);
+
+  // Import into a new map and compare.
+  ohm::OccupancyMap imported(0.1, glm::u8vec3(16));
+  EXPECT_EQ(ohmtools::importOctomap(imported, tree), exported_count);
+  EXPECT_NEAR(imported.hitValue(), map.hitValue(), 1e-5f);
+  EXPECT_NEAR(imported.missValue(), map.missValue(), 1e-5f);
+
+  ohm::Voxel<const float> imported_occupancy(&imported, imported.layout().occupancyLayer());
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(*iter);
+    imported_occupancy.setKey(*iter);
+    if (occupancy.data() == ohm::unobservedOccupancyValue())
+    {
+      EXPECT_TRUE(!imported_occupancy.isValid() || imported_occupancy.data() == ohm::unobservedOccupancyValue());
+      continue;
+    }
+    ASSERT_TRUE(imported_occupancy.isValid());
+    EXPECT_EQ(imported_occupancy.data(), occupancy.data());
+  }
+
+  // Mismatched resolution.
+  ohm::OccupancyMap coarse(0.2);
+  EXPECT_EQ(ohmtools::importOctomap(coarse, tree), 0u);
+}
+}  // namespace octomaptests
@@ -0,0 +1,79 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include <ohmutil/PlyPointStream.h>
+
+#include <glm/glm.hpp>
+
+#include <sstream>
+#include <vector>
+
+namespace ply
+{
+TEST(Ply, PointBuffer)
+{
+  using Property = ohm::PlyPointStream::Property;
+  using Type = ohm::PlyPointStream::Type;
+  const std::vector<Property> properties = { Property{ "x", Type::kFloat64 }, Property{ "y", Type::kFloat64 },
+                                             Property{ "z", Type::kFloat64 }, Property{ "red", Type::kUInt8 },
+                                             Property{ "intensity", Type::kFloat32 } };
+  const unsigned point_count = 100;
+
+  // Write points one at a time.
+  std::ostringstream point_stream;
+  {
+    ohm::PlyPointStream ply(properties, point_stream);
+    for (unsigned i = 0; i < point_count; ++i)
+    {
+      ply.setPointPosition(glm::dvec3(i, -double(i), 0.5 * i));  // NOLINT(readability-magic-numbers)
+      ply.setProperty("red", uint8_t(i));
+      ply.setProperty("intensity", float(i) * 0.25f);  // NOLINT(readability-magic-numbers)
+      ply.writePoint();
+    }
+    EXPECT_TRUE(ply.close());
+  }
+
+  // Write the same points in blocks via a PlyPointBuffer.
+  std::ostringstream buffer_stream;
+  {
+    ohm::PlyPointStream ply(properties, buffer_stream);
+    ohm::PlyPointBuffer buffer(ply.properties());
+    EXPECT_EQ(buffer.pointByteSize(), ply.pointByteSize());
+    const int red = buffer.propertyIndex("red");
+    const int intensity = buffer.propertyIndex("intensity");
+    EXPECT_EQ(buffer.propertyIndex("missing"), -1);
+    for (unsigned i = 0; i < point_count; ++i)
+    {
+      const size_t index = buffer.addPoint();
+      EXPECT_TRUE(buffer.setPointPosition(index, glm::dvec3(i, -double(i), 0.5 * i)));  // NOLINT
+      EXPECT_TRUE(buffer.setProperty(index, red, uint8_t(i)));
+      EXPECT_TRUE(buffer.setProperty(index, intensity, float(i) * 0.25f));  // NOLINT(readability-magic-numbers)
+      // Type size mismatch.
+      EXPECT_FALSE(buffer.setProperty(index, red, float(i)));
+      if (buffer.pointCount() == 32)  // NOLINT(readability-magic-numbers)
+      {
+        EXPECT_TRUE(ply.writePoints(buffer));
+        buffer.clear();
+      }
+    }
+    EXPECT_TRUE(ply.writePoints(buffer));
+    EXPECT_EQ(ply.pointCount(), point_count);
+    EXPECT_TRUE(ply.close());
+  }
+
+  EXPECT_EQ(point_stream.str(), buffer_stream.str());
+
+  // Mismatched layouts are rejected.
+  std::ostringstream bad_stream;
+  ohm::PlyPointStream ply(properties, bad_stream);
+  ohm::PlyPointBuffer bad_buffer({ Property{ "x", Type::kFloat32 } });
+  bad_buffer.addPoint();
+  EXPECT_FALSE(ply.writePoints(bad_buffer));
+}
+}  // namespace ply
@@ -0,0 +1,82 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohmutil/Profile.h>
+#include <ohmutil/ProfileMarker.h>
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace profiletests
+{
+size_t countOccurrences(const std::string &str, const std::string &search)
+{
+  size_t count = 0;
+  for (size_t pos = str.find(search); pos != std::string::npos; pos = str.find(search, pos + search.size()))
+  {
+    ++count;
+  }
+  return count;
+}
+
+
+TEST(Profile, ChromeTrace)
+{
+  ohm::Profile profile;
+  profile.suppressReport(true);
+  const unsigned capacity = 8;
+  profile.enableTimeline(capacity);
+  EXPECT_EQ(profile.timelineCapacity(), capacity);
+
+  // Record more events than the capacity on the second thread to check the ring buffer wraps.
+  const unsigned thread_markers[] = { 2, 20 };
+  std::vector<std::thread> threads;
+  for (unsigned marker_count : thread_markers)
+  {
+    threads.emplace_back([&profile, marker_count]() {
+      for (unsigned i = 0; i < marker_count; ++i)
+      {
+        ohm::ProfileMarker outer("outer", &profile);
+        ohm::ProfileMarker inner("inner", &profile);
+      }
+    });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  std::ostringstream str;
+  profile.writeChromeTrace(str);
+  const std::string trace = str.str();
+
+  EXPECT_EQ(trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+  EXPECT_EQ(countOccurrences(trace, "\"ph\":\"M\""), 2u);
+  // The first thread records 4 events, the second only retains the capacity.
+  EXPECT_EQ(countOccurrences(trace, "\"ph\":\"X\""), 4u + capacity);
+  EXPECT_EQ(countOccurrences(trace, "\"name\":\"outer\""), countOccurrences(trace, "\"name\":\"inner\""));
+}
+
+
+TEST(Profile, TimelineDisabled)
+{
+  ohm::Profile profile;
+  profile.suppressReport(true);
+  EXPECT_EQ(profile.timelineCapacity(), 0u);
+  {
+    ohm::ProfileMarker marker("marker", &profile);
+  }
+
+  std::ostringstream str;
+  profile.writeChromeTrace(str);
+  EXPECT_EQ(countOccurrences(str.str(), "\"ph\":\"X\""), 0u);
+}
+}  // namespace profiletests
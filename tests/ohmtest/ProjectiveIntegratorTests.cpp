@@ -0,0 +1,163 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/ProjectiveIntegrator.h>
+#include <ohm/VoxelData.h>
+#include <ohm/VoxelOccupancy.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+
+namespace projective
+{
+/// Build a depth image of a wall facing the camera at @p depth with an invalid top row.
+std::vector<float> wallImage(const ohm::DepthCamera &camera, float depth)
+{
+  std::vector<float> image(size_t(camera.width) * camera.height, depth);
+  for (unsigned u = 0; u < camera.width; ++u)
+  {
+    image[u] = 0.0f;
+  }
+  return image;
+}
+
+TEST(Projective, Occupancy)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16), ohm::MapFlag::kTsdf);
+  ohm::ProjectiveIntegrator integrator(&map);
+  ASSERT_TRUE(integrator.valid());
+
+  ohm::DepthCamera camera;
+  camera.width = 64;
+  camera.height = 48;
+  camera.fx = camera.fy = 50.0;
+  camera.cx = 31.5;
+  camera.cy = 23.5;
+  camera.max_depth = 5.0;
+  integrator.setCamera(camera);
+
+  ohm::TsdfOptions tsdf_options = integrator.tsdfOptions();
+  tsdf_options.default_truncation_distance = 0.3f;
+  integrator.setTsdfOptions(tsdf_options);
+
+  // Wall between voxel centres so only the voxel layer at 2.05 is within half a voxel of the surface.
+  const float wall_depth = 2.02f;
+  const std::vector<float> depth = wallImage(camera, wall_depth);
+  const size_t update_count = integrator.integrate(depth.data(), glm::dmat4(1.0));
+  EXPECT_GT(update_count, 0u);
+  EXPECT_GT(integrator.regionCount(), 0u);
+
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::VoxelTsdf> tsdf(&map, map.layout().layerIndex(ohm::default_layer::tsdfLayerName()));
+  ASSERT_TRUE(occupancy.isLayerValid());
+  ASSERT_TRUE(tsdf.isLayerValid());
+
+  // Sample a column of voxels along the camera axis.
+  const glm::dvec3 column(0.05, 0.05, 0.0);
+  for (int i = 2; i < 40; ++i)
+  {
+    const glm::dvec3 centre = column + glm::dvec3(0, 0, 0.1 * i + 0.05);
+    const ohm::Key key = map.voxelKey(centre);
+    ohm::setVoxelKey(key, occupancy, tsdf);
+    ASSERT_TRUE(occupancy.isValid() || centre.z > wall_depth) << centre.z;
+
+    float occupancy_value = ohm::unobservedOccupancyValue();
+    if (occupancy.isValid())
+    {
+      occupancy.read(&occupancy_value);
+    }
+
+    if (centre.z < wall_depth - 0.05)
+    {
+      EXPECT_TRUE(ohm::isFree(occupancy_value, map)) << centre.z;
+    }
+    else if (centre.z <= wall_depth + 0.05)
+    {
+      EXPECT_TRUE(ohm::isOccupied(occupancy_value, map)) << centre.z;
+    }
+    else
+    {
+      EXPECT_TRUE(ohm::isUnobserved(occupancy_value)) << centre.z;
+    }
+
+    // TSDF is updated within the truncation distance behind the surface, positive in front of it.
+    ohm::VoxelTsdf tsdf_value{ 0, 0 };
+    if (tsdf.isValid())
+    {
+      tsdf.read(&tsdf_value);
+    }
+    const double sdf = wall_depth - centre.z;
+    if (sdf >= -tsdf_options.default_truncation_distance)
+    {
+      EXPECT_GT(tsdf_value.weight, 0.0f) << centre.z;
+      EXPECT_NEAR(tsdf_value.distance, std::min(sdf, double(tsdf_options.default_truncation_distance)), 1e-3)
+        << centre.z;
+    }
+    else
+    {
+      EXPECT_EQ(tsdf_value.weight, 0.0f) << centre.z;
+    }
+  }
+
+  // Voxels projecting onto the invalid top row are untouched.
+  ohm::setVoxelKey(map.voxelKey(glm::dvec3(0.05, -0.45, 0.95)), occupancy);
+  float top_value = ohm::unobservedOccupancyValue();
+  if (occupancy.isValid())
+  {
+    occupancy.read(&top_value);
+  }
+  EXPECT_TRUE(ohm::isUnobserved(top_value));
+}
+
+TEST(Projective, Threads)
+{
+  // Threaded integration must match the serial integration.
+  ohm::OccupancyMap serial_map(0.1, glm::u8vec3(16));
+  ohm::OccupancyMap threaded_map(0.1, glm::u8vec3(16));
+  ohm::ProjectiveIntegrator serial(&serial_map);
+  ohm::ProjectiveIntegrator threaded(&threaded_map);
+  threaded.setUseThreads(true);
+
+  ohm::DepthCamera camera;
+  camera.width = 80;
+  camera.height = 60;
+  camera.fx = camera.fy = 60.0;
+  camera.cx = 39.5;
+  camera.cy = 29.5;
+  serial.setCamera(camera);
+  threaded.setCamera(camera);
+
+  // A sloped floor in front of the camera.
+  std::vector<float> depth(size_t(camera.width) * camera.height);
+  for (unsigned v = 0; v < camera.height; ++v)
+  {
+    for (unsigned u = 0; u < camera.width; ++u)
+    {
+      depth[v * camera.width + u] = 1.0f + 0.05f * float(camera.height - v) + 0.01f * float(u);
+    }
+  }
+
+  const glm::dmat4 pose = glm::translate(glm::dmat4(1.0), glm::dvec3(0.3, -0.2, 0.1));
+  EXPECT_EQ(serial.integrate(depth.data(), pose), threaded.integrate(depth.data(), pose));
+  ASSERT_EQ(serial_map.regionCount(), threaded_map.regionCount());
+
+  ohm::Voxel<const float> threaded_occupancy(&threaded_map, threaded_map.layout().occupancyLayer());
+  for (auto iter = serial_map.begin(); iter != serial_map.end(); ++iter)
+  {
+    ohm::Voxel<const float> serial_occupancy(&serial_map, serial_map.layout().occupancyLayer(), *iter);
+    ohm::setVoxelKey(*iter, threaded_occupancy);
+    ASSERT_TRUE(threaded_occupancy.isValid());
+    EXPECT_EQ(serial_occupancy.data(), threaded_occupancy.data());
+  }
+}
+}  // namespace projective
@@ -7,6 +7,7 @@
 
 #include "RayValidation.h"
 
+#include <ohm/ClearingBatch.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/RayPatternConical.h>
 #include <ohm/VoxelData.h>
@@ -215,6 +216,126 @@ TEST(RayPattern, Clearing)
   voxel_read.reset();
 }
 
+TEST(RayPattern, KeyTemplate)
+{
+  // As for the Clearing test, but using the key template. We also validate the template is reused.
+  const unsigned voxel_count = 20;
+  ohm::OccupancyMap map;
+
+  map.setHitProbability(0.51f);
+  map.setMissProbability(0.0f);
+  const float miss_value = map.missValue();
+
+  ohm::Key key(0, 0, 0, 0, 0, 0);
+  {
+    ohm::Voxel<float> voxel_write(&map, map.layout().occupancyLayer());
+    ASSERT_TRUE(voxel_write.isLayerValid());
+    for (unsigned i = 0; i < voxel_count; ++i)
+    {
+      voxel_write.setKey(key);
+      ASSERT_TRUE(voxel_write.isValid());
+      ohm::integrateHit(voxel_write);
+      ASSERT_TRUE(isOccupied(voxel_write));
+      map.moveKey(key, 1, 0, 0);
+    }
+  }
+
+  RayPattern line_pattern;
+  line_pattern.addPoint(glm::dvec3(0, map.resolution() * voxel_count, 0));
+  ClearingPattern clearing(&line_pattern, false);
+
+  key = ohm::Key(0, 0, 0, 0, 0, 0);
+  const glm::dquat rotation = glm::angleAxis(-0.5 * M_PI, glm::dvec3(0, 0, 1));
+  const glm::ivec3 *key_template = nullptr;
+  size_t key_template_size = 0;
+  ohm::Voxel<const float> voxel_read(&map, map.layout().occupancyLayer());
+  ASSERT_TRUE(voxel_read.isLayerValid());
+  for (unsigned i = 0; i < voxel_count; ++i)
+  {
+    voxel_read.setKey(key);
+    ASSERT_TRUE(isOccupied(voxel_read));
+
+    // Translate the pattern with each application. Only the first application builds the template.
+    clearing.applyKeyTemplate(&map, map.voxelCentreGlobal(key), rotation);
+
+    size_t element_count = 0;
+    const glm::ivec3 *current_template = clearing.keyTemplate(&element_count);
+    if (i == 0)
+    {
+      key_template = current_template;
+      key_template_size = element_count;
+      ASSERT_GT(key_template_size, 0u);
+      // The template starts in the origin voxel and steps along X.
+      EXPECT_EQ(key_template[0], glm::ivec3(0));
+      EXPECT_EQ(key_template[1], glm::ivec3(1, 0, 0));
+    }
+    EXPECT_EQ(current_template, key_template);
+    EXPECT_EQ(element_count, key_template_size);
+
+    ASSERT_TRUE(!isOccupied(voxel_read));
+    // The map miss value is unchanged.
+    EXPECT_EQ(map.missValue(), miss_value);
+
+    map.moveKey(key, 1, 0, 0);
+  }
+  voxel_read.reset();
+}
+
+TEST(RayPattern, ClearingBatch)
+{
+  // Clear multiple voxels along X using a batch of single ray patterns, one per voxel.
+  const unsigned voxel_count = 20;
+  ohm::OccupancyMap map;
+
+  map.setHitProbability(0.51f);
+  map.setMissProbability(0.0f);
+
+  ohm::Key key(0, 0, 0, 0, 0, 0);
+  {
+    ohm::Voxel<float> voxel_write(&map, map.layout().occupancyLayer());
+    ASSERT_TRUE(voxel_write.isLayerValid());
+    for (unsigned i = 0; i < voxel_count; ++i)
+    {
+      voxel_write.setKey(key);
+      ohm::integrateHit(voxel_write);
+      ASSERT_TRUE(isOccupied(voxel_write));
+      map.moveKey(key, 1, 0, 0);
+    }
+  }
+
+  RayPattern line_pattern;
+  line_pattern.addPoint(glm::dvec3(0, map.resolution() * voxel_count, 0));
+  ClearingPattern clearing(&line_pattern, false);
+  const glm::dquat rotation = glm::angleAxis(-0.5 * M_PI, glm::dvec3(0, 0, 1));
+
+  // Each ray stops on the first occupied voxel, so each pose clears the voxel it starts in.
+  ohm::ClearingBatch batch;
+  key = ohm::Key(0, 0, 0, 0, 0, 0);
+  for (unsigned i = 0; i < voxel_count; ++i)
+  {
+    batch.add(clearing, map.voxelCentreGlobal(key), rotation);
+    map.moveKey(key, 1, 0, 0);
+  }
+
+  EXPECT_EQ(batch.rayCount(), voxel_count);
+  EXPECT_EQ(batch.groupCount(), 1u);
+
+  const float miss_value = map.missValue();
+  EXPECT_EQ(batch.apply(&map), voxel_count);
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(map.missValue(), miss_value);
+
+  key = ohm::Key(0, 0, 0, 0, 0, 0);
+  ohm::Voxel<const float> voxel_read(&map, map.layout().occupancyLayer());
+  for (unsigned i = 0; i < voxel_count; ++i)
+  {
+    voxel_read.setKey(key);
+    EXPECT_FALSE(isOccupied(voxel_read));
+    map.moveKey(key, 1, 0, 0);
+  }
+  voxel_read.reset();
+}
+
 TEST(RayPattern, Exclude)
 {
   // First build a simple map with three voxels of interest along X: { unobserved, free, occupied, occupied }
@@ -14,6 +14,13 @@
 
 #include <gtest/gtest.h>
 
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+
 namespace raysquerytests
 {
 TEST(RaysQuery, Cpu)
@@ -130,4 +137,192 @@ TEST(RaysQuery, Cpu)
     query.reset(true);
   }
 }
+
+
+TEST(RaysQuery, Threads)
+{
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  const double resolution = 0.1;
+  const unsigned ray_count = 5000;
+  ohm::OccupancyMap map(resolution);
+  ohm::RayMapperOccupancy mapper(&map);
+
+  // Build a map from short random rays, then query with longer rays which pass through observed and unobserved space.
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-3.0, 3.0);
+  std::vector<glm::dvec3> rays;
+  for (unsigned i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    rays[i] *= 2.0;
+  }
+
+  ohm::RaysQuery reference;
+  reference.setMap(&map);
+  reference.setUseThreads(false);
+  reference.setRays(rays);
+  ASSERT_TRUE(reference.execute());
+  ASSERT_EQ(reference.numberOfResults(), ray_count);
+
+  const auto compare = [&reference](const ohm::RaysQuery &query) {
+    ASSERT_EQ(query.numberOfResults(), reference.numberOfResults());
+    for (size_t i = 0; i < query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(query.ranges()[i], reference.ranges()[i]) << i;
+      EXPECT_EQ(query.unobservedVolumes()[i], reference.unobservedVolumes()[i]) << i;
+      EXPECT_EQ(query.terminalOccupancyTypes()[i], reference.terminalOccupancyTypes()[i]) << i;
+      EXPECT_EQ(query.intersectedVoxels()[i], reference.intersectedVoxels()[i]) << i;
+    }
+  };
+
+  ohm::RaysQuery query;
+  query.setMap(&map);
+  query.setRays(rays);
+  ASSERT_TRUE(query.execute());
+  compare(query);
+
+  // Run asynchronously.
+  ASSERT_TRUE(query.executeAsync());
+  ASSERT_TRUE(query.wait());
+  compare(query);
+}
+
+
+TEST(RaysQuery, Async)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution);
+  ohm::RayMapperOccupancy mapper(&map);
+
+  std::vector<glm::dvec3> rays;
+  for (int i = 0; i < 1000; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(std::cos(i * 0.01), std::sin(i * 0.01), 0.1 * std::sin(i * 0.1)));  // NOLINT
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+
+  ohm::RaysQuery reference;
+  reference.setMap(&map);
+  reference.setRays(rays);
+  ASSERT_TRUE(reference.execute());
+
+  // Execute with a completion callback. Results must be available in the callback.
+  ohm::RaysQuery query;
+  query.setMap(&map);
+  query.setRays(rays);
+  std::atomic_int callback_count{ 0 };
+  std::atomic_size_t callback_results{ 0 };
+  ASSERT_TRUE(query.executeAsync([&](ohm::Query &completed, bool ok) {
+    EXPECT_EQ(&completed, &query);
+    EXPECT_TRUE(ok);
+    callback_results = completed.numberOfResults();
+    ++callback_count;
+  }));
+
+  // Poll without blocking until done.
+  while (!query.wait(0))
+  {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(callback_count, 1);
+  EXPECT_EQ(callback_results, reference.numberOfResults());
+  ASSERT_EQ(query.numberOfResults(), reference.numberOfResults());
+  for (size_t i = 0; i < query.numberOfResults(); ++i)
+  {
+    EXPECT_EQ(query.ranges()[i], reference.ranges()[i]) << i;
+    EXPECT_EQ(query.terminalOccupancyTypes()[i], reference.terminalOccupancyTypes()[i]) << i;
+  }
+
+  // Waiting again must not re-invoke the callback.
+  EXPECT_TRUE(query.wait());
+  EXPECT_EQ(callback_count, 1);
+
+  // Start another query then destroy the query object without waiting. The destructor must wait.
+  {
+    ohm::RaysQuery pending;
+    pending.setMap(&map);
+    pending.setRays(rays);
+    ASSERT_TRUE(pending.executeAsync([&callback_count](ohm::Query &, bool) { ++callback_count; }));
+  }
+  EXPECT_EQ(callback_count, 2);
+}
+
+TEST(RaysQuery, Incremental)
+{
+  const double resolution = 0.1;
+  const unsigned ray_count = 2000;
+  ohm::OccupancyMap map(resolution);
+  ohm::RayMapperOccupancy mapper(&map);
+
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-3.0, 3.0);
+  std::vector<glm::dvec3> rays;
+  for (unsigned i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+  mapper.integrateRays(rays.data(), rays.size());
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    rays[i] *= 2.0;
+  }
+
+  const auto compare = [&map, &rays](const ohm::RaysQuery &query) {
+    ohm::RaysQuery reference;
+    reference.setMap(&map);
+    reference.setRays(rays);
+    ASSERT_TRUE(reference.execute());
+    ASSERT_EQ(query.numberOfResults(), reference.numberOfResults());
+    for (size_t i = 0; i < query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(query.ranges()[i], reference.ranges()[i]) << i;
+      EXPECT_EQ(query.unobservedVolumes()[i], reference.unobservedVolumes()[i]) << i;
+      EXPECT_EQ(query.terminalOccupancyTypes()[i], reference.terminalOccupancyTypes()[i]) << i;
+      EXPECT_EQ(query.intersectedVoxels()[i], reference.intersectedVoxels()[i]) << i;
+    }
+  };
+
+  ohm::RaysQuery query;
+  query.setMap(&map);
+  query.setIncremental(true);
+  query.setRays(rays);
+
+  // The first execution evaluates every ray.
+  ASSERT_TRUE(query.execute());
+  EXPECT_EQ(query.evaluatedRayCount(), ray_count);
+  compare(query);
+
+  // Nothing is evaluated without a map change.
+  ASSERT_TRUE(query.execute());
+  EXPECT_EQ(query.evaluatedRayCount(), 0u);
+  compare(query);
+
+  // Modify a single region. Only rays traversing that region are evaluated.
+  ohm::integrateHit(map, map.voxelKey(glm::dvec3(2.5)));
+  ASSERT_TRUE(query.execute());
+  EXPECT_GT(query.evaluatedRayCount(), 0u);
+  EXPECT_LT(query.evaluatedRayCount(), ray_count);
+  compare(query);
+
+  // Only added rays are evaluated.
+  rays.emplace_back(glm::dvec3(0.0));
+  rays.emplace_back(glm::dvec3(-4.0, 1.0, 2.0));
+  query.addRay(rays[rays.size() - 2], rays.back());
+  ASSERT_TRUE(query.execute());
+  EXPECT_EQ(query.evaluatedRayCount(), 1u);
+  compare(query);
+
+  // Invalidation evaluates every ray.
+  query.invalidate();
+  ASSERT_TRUE(query.execute());
+  EXPECT_EQ(query.evaluatedRayCount(), ray_count + 1u);
+  compare(query);
+}
 }  // namespace raysquerytests
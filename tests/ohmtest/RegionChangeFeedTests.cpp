@@ -0,0 +1,166 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RegionChangeFeed.h>
+#include <ohm/VoxelData.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace regionchangefeedtests
+{
+/// Sort and compare region key lists.
+void compareRegions(std::vector<glm::i16vec3> regions, std::vector<glm::i16vec3> expected)
+{
+  const auto less = [](const glm::i16vec3 &a, const glm::i16vec3 &b) {
+    return a.x < b.x || a.x == b.x && (a.y < b.y || a.y == b.y && a.z < b.z);
+  };
+  std::sort(regions.begin(), regions.end(), less);
+  std::sort(expected.begin(), expected.end(), less);
+  EXPECT_EQ(regions, expected);
+}
+
+
+/// Collect the regions dirtied after @p from_stamp by a full scan.
+std::vector<glm::i16vec3> scanDirtyRegions(const ohm::OccupancyMap &map, uint64_t from_stamp)
+{
+  std::vector<std::pair<uint64_t, glm::i16vec3>> dirty;
+  map.collectDirtyRegions(from_stamp, dirty);
+  std::vector<glm::i16vec3> regions;
+  for (const auto &entry : dirty)
+  {
+    regions.emplace_back(entry.second);
+  }
+  return regions;
+}
+
+
+TEST(RegionChangeFeed, Drain)
+{
+  // Validate the feed against the full dirty region scan across successive updates.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohm::RegionChangeFeed feed(map);
+  EXPECT_TRUE(feed.isSubscribed());
+  EXPECT_EQ(feed.pendingCount(), 0u);
+
+  std::vector<glm::i16vec3> regions;
+  uint64_t from_stamp = map.stamp();
+  for (unsigned i = 0; i < 3; ++i)
+  {
+    ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 1.0 + i * 2.0, 500u, 0x1234u + i);
+    EXPECT_GT(feed.pendingCount(), 0u);
+    regions.clear();
+    EXPECT_EQ(feed.drain(regions), regions.size());
+    EXPECT_EQ(feed.pendingCount(), 0u);
+    compareRegions(regions, scanDirtyRegions(map, from_stamp));
+    from_stamp = map.stamp();
+  }
+
+  // Nothing more to drain.
+  regions.clear();
+  EXPECT_EQ(feed.drain(regions), 0u);
+
+  // Single voxel writes notify once per region regardless of the number of writes.
+  const ohm::Key key = map.voxelKey(glm::dvec3(0.0));
+  ohm::Voxel<float> voxel(&map, map.layout().occupancyLayer(), key);
+  ASSERT_TRUE(voxel.isValid());
+  for (unsigned i = 0; i < 10; ++i)
+  {
+    voxel.write(map.hitValue() * float(i));
+  }
+  voxel.reset();
+  EXPECT_EQ(feed.drain(regions), 1u);
+  ASSERT_EQ(regions.size(), 1u);
+  EXPECT_EQ(regions.front(), key.regionKey());
+
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 2.0, 500u, 0x4321u);
+  feed.clear();
+  EXPECT_EQ(feed.pendingCount(), 0u);
+}
+
+
+TEST(RegionChangeFeed, Lifetime)
+{
+  // Validate multiple subscribers and feeds outliving the map.
+  std::unique_ptr<ohm::OccupancyMap> map = std::make_unique<ohm::OccupancyMap>(0.25, glm::u8vec3(8));
+  ohm::RegionChangeFeed feed_a(*map);
+  std::unique_ptr<ohm::RegionChangeFeed> feed_b = std::make_unique<ohm::RegionChangeFeed>(*map);
+
+  ohmtestutil::integrateRandomRays(*map, glm::dvec3(0.0), 2.0, 500u, 0x1234u);
+  const size_t pending_count = feed_a.pendingCount();
+  EXPECT_GT(pending_count, 0u);
+  EXPECT_EQ(feed_b->pendingCount(), pending_count);
+
+  // Draining one feed does not affect another.
+  std::vector<glm::i16vec3> regions;
+  feed_b->drain(regions);
+  EXPECT_EQ(feed_a.pendingCount(), pending_count);
+  feed_b.reset();
+
+  ohmtestutil::integrateRandomRays(*map, glm::dvec3(0.0), 2.0, 500u, 0x4321u);
+  EXPECT_GE(feed_a.pendingCount(), pending_count);
+
+  map.reset();
+  EXPECT_FALSE(feed_a.isSubscribed());
+  regions.clear();
+  EXPECT_GT(feed_a.drain(regions), 0u);
+}
+
+
+TEST(RegionChangeFeed, Rebase)
+{
+  // Validate a rebase re-keys the pending regions, invokes the callback, then queues all re-keyed regions.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohm::RegionChangeFeed feed(map);
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 2.0, 500u, 0x1234u);
+
+  // Leave a single region pending.
+  std::vector<glm::i16vec3> regions;
+  feed.drain(regions);
+  const glm::i16vec3 pending_key(5, 0, 0);
+  {
+    ohm::Voxel<float> voxel(&map, map.layout().occupancyLayer(), ohm::Key(pending_key, 0, 0, 0));
+    ASSERT_TRUE(voxel.isValid());
+    ohm::integrateHit(voxel);
+  }
+  ASSERT_EQ(feed.pendingCount(), 1u);
+
+  glm::dvec3 callback_shift(0);
+  std::vector<glm::i16vec3> callback_regions;
+  feed.setRebaseCallback([&](const glm::dvec3 &region_shift) {
+    callback_shift = region_shift;
+    feed.drain(callback_regions);
+  });
+
+  const glm::i16vec3 rebase_key(3, 0, 0);
+  EXPECT_EQ(feed.rebaseCount(), 0u);
+  ASSERT_TRUE(map.rebaseOrigin(map.regionCentreGlobal(rebase_key)));
+  EXPECT_EQ(feed.rebaseCount(), 1u);
+  EXPECT_EQ(callback_shift, glm::dvec3(rebase_key));
+  ASSERT_EQ(callback_regions.size(), 1u);
+  EXPECT_EQ(callback_regions.front(), glm::i16vec3(pending_key - rebase_key));
+
+  // Every region is queued under its new key after the callback.
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  std::vector<glm::i16vec3> expected;
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    expected.emplace_back(chunk->region.coord);
+  }
+  regions.clear();
+  feed.drain(regions);
+  compareRegions(regions, expected);
+}
+}  // namespace regionchangefeedtests
@@ -0,0 +1,151 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <gtest/gtest.h>
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapChunk.h>
+#include <ohm/MapLayout.h>
+#include <ohm/Mapper.h>
+#include <ohm/MappingProcess.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RegionScheduler.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmutil/GlmStream.h>
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace regionscheduler
+{
+/// Dummy process used to validate @c Mapper reference position propagation.
+class NullProcess : public ohm::MappingProcess
+{
+public:
+  void reset() override {}
+  int update(ohm::OccupancyMap & /*map*/, double /*time_slice*/) override { return ohm::kMprUpToDate; }
+};
+
+
+TEST(RegionScheduler, Distance)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(10));
+  ohm::RegionScheduler scheduler;
+  scheduler.setStalenessWeight(0);
+
+  const std::vector<glm::i16vec3> expected_order = { glm::i16vec3(0), glm::i16vec3(1, 0, 0),
+                                                     glm::i16vec3(-2, 1, 0), glm::i16vec3(0, 0, 4),
+                                                     glm::i16vec3(-6, 3, 2) };
+  // Push in reverse order.
+  for (auto iter = expected_order.rbegin(); iter != expected_order.rend(); ++iter)
+  {
+    EXPECT_TRUE(scheduler.push(*iter));
+  }
+  // Duplicates are ignored.
+  EXPECT_FALSE(scheduler.push(expected_order.front()));
+  EXPECT_EQ(scheduler.size(), expected_order.size());
+
+  scheduler.setReferencePosition(map.regionSpatialCentre(glm::i16vec3(0)));
+  glm::i16vec3 region_key;
+  for (const auto &expected : expected_order)
+  {
+    ASSERT_TRUE(scheduler.pop(map, &region_key));
+    EXPECT_EQ(region_key, expected);
+  }
+  EXPECT_TRUE(scheduler.empty());
+  EXPECT_FALSE(scheduler.pop(map, &region_key));
+}
+
+
+TEST(RegionScheduler, Staleness)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(10));
+  ohm::RegionScheduler scheduler;
+  const glm::i16vec3 far_region(10, 0, 0);
+  const glm::i16vec3 near_region(1, 0, 0);
+
+  // A very high staleness weight lets the old, far region jump ahead of the nearer one.
+  scheduler.setStalenessWeight(1e4);  // NOLINT(readability-magic-numbers)
+  scheduler.setReferencePosition(map.regionSpatialCentre(glm::i16vec3(0)));
+  scheduler.push(far_region);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));  // NOLINT(readability-magic-numbers)
+  scheduler.push(near_region);
+
+  glm::i16vec3 region_key;
+  ASSERT_TRUE(scheduler.pop(map, &region_key));
+  EXPECT_EQ(region_key, far_region);
+  scheduler.clear();
+
+  // Regions in the priority radius always come first, regardless of staleness.
+  scheduler.setPriorityRadius(1.5 * map.regionSpatialResolution().x);
+  scheduler.push(far_region);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));  // NOLINT(readability-magic-numbers)
+  scheduler.push(near_region);
+  ASSERT_TRUE(scheduler.pop(map, &region_key));
+  EXPECT_EQ(region_key, near_region);
+  ASSERT_TRUE(scheduler.pop(map, &region_key));
+  EXPECT_EQ(region_key, far_region);
+}
+
+
+TEST(RegionScheduler, DirtyRegions)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(10));
+  ohm::MapLayout layout = map.layout();
+  ohm::addClearance(layout);
+  map.updateLayout(layout);
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int clearance_layer = map.layout().clearanceLayer();
+
+  ohm::integrateHit(map, map.voxelKey(glm::dvec3(0.05)));
+  ohm::integrateHit(map, map.voxelKey(glm::dvec3(3.05)));
+
+  ohm::RegionScheduler scheduler;
+  EXPECT_EQ(scheduler.pushDirtyRegions(map, occupancy_layer, clearance_layer), 2u);
+  EXPECT_EQ(scheduler.pushDirtyRegions(map, occupancy_layer, clearance_layer), 0u);
+  scheduler.clear();
+
+  // With padding we get the neighbours.
+  EXPECT_EQ(scheduler.pushDirtyRegions(map, occupancy_layer, clearance_layer, 1), 2u * 27u);
+  scheduler.clear();
+
+  // Bring the derived layer up to date for one region.
+  ohm::MapChunk *chunk = map.region(map.regionKey(glm::dvec3(0.05)));
+  ASSERT_NE(chunk, nullptr);
+  chunk->touched_stamps[clearance_layer] = chunk->touched_stamps[occupancy_layer].load();
+  EXPECT_EQ(scheduler.pushDirtyRegions(map, occupancy_layer, clearance_layer), 1u);
+}
+
+
+TEST(RegionScheduler, MapperReference)
+{
+  ohm::Mapper mapper;
+  auto *process = new NullProcess;
+  mapper.addProcess(process);
+  EXPECT_FALSE(process->hasReferencePosition());
+
+  const glm::dvec3 position(1, 2, 3);
+  mapper.setReferencePosition(position);
+  EXPECT_TRUE(process->hasReferencePosition());
+  EXPECT_EQ(process->referencePosition(), position);
+
+  // New processes inherit the reference position.
+  auto *process2 = new NullProcess;
+  mapper.addProcess(process2);
+  EXPECT_TRUE(process2->hasReferencePosition());
+  EXPECT_EQ(process2->referencePosition(), position);
+
+  mapper.clearReferencePosition();
+  EXPECT_FALSE(process->hasReferencePosition());
+  EXPECT_FALSE(process2->hasReferencePosition());
+}
+}  // namespace regionscheduler
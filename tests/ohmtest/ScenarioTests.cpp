@@ -0,0 +1,119 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohm/Key.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmtools/OhmScenario.h>
+
+#include <gtest/gtest.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace scenariotests
+{
+TEST(Scenario, Raycast)
+{
+  ohmgen::Scenario scenario;
+  scenario.addBox(glm::dvec3(-5, -5, -5), glm::dvec3(5, 5, 5));
+  scenario.addBox(glm::dvec3(-4, -1, -1), glm::dvec3(4, 1, 1), true);
+  scenario.addCylinder(glm::dvec3(0, 10, -1), 1.0, 2.0);
+
+  EXPECT_TRUE(scenario.occupied(glm::dvec3(0, 3, 0)));
+  EXPECT_FALSE(scenario.occupied(glm::dvec3(0, 0, 0)));
+  EXPECT_TRUE(scenario.occupied(glm::dvec3(0, 10, 0)));
+  EXPECT_FALSE(scenario.occupied(glm::dvec3(0.9, 10.9, 0)));
+
+  // From inside the carved corridor to its end wall.
+  double range = 0;
+  ASSERT_TRUE(scenario.raycast(glm::dvec3(0, 0, 0), glm::dvec3(1, 0, 0), 20.0, &range));
+  EXPECT_NEAR(range, 4.0, 1e-5);
+
+  // From outside, through the solid box, over the corridor.
+  ASSERT_TRUE(scenario.raycast(glm::dvec3(-10, 0, 0), glm::dvec3(1, 0, 0), 20.0, &range));
+  EXPECT_NEAR(range, 5.0, 1e-5);
+
+  // The cylinder.
+  ASSERT_TRUE(scenario.raycast(glm::dvec3(-10, 10, 0), glm::dvec3(1, 0, 0), 20.0, &range));
+  EXPECT_NEAR(range, 9.0, 1e-5);
+
+  // Out of range and a miss.
+  EXPECT_FALSE(scenario.raycast(glm::dvec3(-10, 10, 0), glm::dvec3(1, 0, 0), 8.0, &range));
+  EXPECT_FALSE(scenario.raycast(glm::dvec3(-10, 20, 0), glm::dvec3(1, 0, 0), 20.0, &range));
+}
+
+
+TEST(Scenario, Generate)
+{
+  const ohmgen::ScenarioType types[] = { ohmgen::ScenarioType::kUrban, ohmgen::ScenarioType::kForest,
+                                         ohmgen::ScenarioType::kTunnel };
+  for (ohmgen::ScenarioType type : types)
+  {
+    ohmgen::ScenarioParams params;
+    params.type = type;
+    params.extents = glm::dvec3(40, 40, 10);
+    const ohmgen::Scenario scenario = ohmgen::Scenario::generate(params);
+    ASSERT_FALSE(scenario.shapes().empty());
+    ASSERT_GE(scenario.path().size(), 2u);
+
+    // The path must be collision free.
+    for (const glm::dvec3 &waypoint : scenario.path())
+    {
+      EXPECT_FALSE(scenario.occupied(waypoint));
+    }
+
+    std::vector<ohmgen::TrajectorySample> trajectory;
+    ASSERT_GT(ohmgen::generateTrajectory(scenario, 2.0, 0.1, trajectory), 1u);
+
+    ohmgen::LidarParams lidar;
+    lidar.azimuth_samples = 64;
+    std::vector<glm::dvec3> rays;
+    std::vector<double> timestamps;
+    const size_t threaded_count = ohmgen::generateRays(scenario, trajectory, lidar, rays, &timestamps, true);
+    ASSERT_GT(threaded_count, 0u);
+    ASSERT_EQ(rays.size(), threaded_count * 2);
+    ASSERT_EQ(timestamps.size(), threaded_count);
+
+    // Results are independent of threading.
+    std::vector<glm::dvec3> serial_rays;
+    ohmgen::generateRays(scenario, trajectory, lidar, serial_rays, nullptr, false);
+    EXPECT_EQ(serial_rays, rays);
+
+    // Samples lie on the surface. Allow for rays which graze an edge.
+    size_t surface_count = 0;
+    for (size_t i = 0; i < rays.size(); i += 2)
+    {
+      surface_count += scenario.occupied(rays[i + 1] + 1e-3 * glm::normalize(rays[i + 1] - rays[i]));
+    }
+    EXPECT_GE(surface_count, threaded_count * 99 / 100);
+  }
+}
+
+
+TEST(Scenario, PopulateMap)
+{
+  ohmgen::Scenario scenario;
+  scenario.addBox(glm::dvec3(0, 0, 0), glm::dvec3(1, 1, 0.5));
+  scenario.addBox(glm::dvec3(0, 0, 0), glm::dvec3(2, 2, 1));
+  scenario.addBox(glm::dvec3(0.5, 0.5, 0), glm::dvec3(1.5, 1.5, 1), true);
+
+  ohm::OccupancyMap map(0.1, glm::u8vec3(8));
+  const size_t occupied = ohmgen::populateMap(map, scenario, true, true);
+  // 20 x 20 x 10 voxels less a carved 10 x 10 x 10 hole.
+  EXPECT_EQ(occupied, 3000u);
+
+  ohm::Voxel<const float> voxel(&map, map.layout().occupancyLayer());
+  voxel.setKey(map.voxelKey(glm::dvec3(0.25, 0.25, 0.25)));
+  EXPECT_TRUE(ohm::isOccupied(voxel));
+  voxel.setKey(map.voxelKey(glm::dvec3(1.05, 1.05, 0.55)));
+  EXPECT_TRUE(ohm::isFree(voxel));
+
+  ohm::OccupancyMap serial_map(0.1, glm::u8vec3(8));
+  EXPECT_EQ(ohmgen::populateMap(serial_map, scenario, false, false), occupied);
+}
+}  // namespace scenariotests
@@ -8,13 +8,21 @@
 #include "ohmtestcommon/OhmTestUtil.h"
 #include "ohmtestcommon/WalkSegmentKeysLegacy.h"
 
+#include <ohm/Aabb.h>
 #include <ohm/CalculateSegmentKeys.h>
+#include <ohm/DefaultLayer.h>
 #include <ohm/Key.h>
 #include <ohm/KeyList.h>
 #include <ohm/LineQuery.h>
+#include <ohm/MapChunk.h>
 #include <ohm/MapSerialise.h>
+#include <ohm/MapUpgrade.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/OccupancyUtil.h>
+#include <ohm/Stream.h>
+#include <ohm/VoxelBlock.h>
+#include <ohm/VoxelBuffer.h>
+#include <ohm/VoxelData.h>
 #include <ohm/VoxelOccupancy.h>
 
 #include <ohmtools/OhmCloud.h>
@@ -23,7 +31,12 @@
 #include <logutil/LogUtil.h>
 #include <ohmutil/Profile.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <memory>
@@ -104,6 +117,678 @@ TEST(Serialisation, Basic)
 }
 
 
+TEST(Serialisation, SaveAsync)
+{
+  const char *map_name = "test-map-async.ohm";
+  OccupancyMap save_map(0.25);
+  OccupancyMap load_map(1);
+
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  const std::unique_ptr<OccupancyMap> reference_map(save_map.clone());
+  const size_t saved_region_count = save_map.regionCount();
+
+  ProgressDisplay progress;
+  std::future<int> save_result = saveAsync(map_name, save_map, &progress);
+
+  // Keep mapping while saving, adding regions beyond the room and changing existing ones.
+  for (double x = -4.0; x <= 4.0; x += save_map.resolution())
+  {
+    integrateHit(save_map, save_map.voxelKey(glm::dvec3(x, 0.5, 0.1)));
+  }
+  EXPECT_GT(save_map.regionCount(), saved_region_count);
+
+  ASSERT_EQ(save_result.get(), 0);
+  EXPECT_EQ(progress.target(), saved_region_count);
+  EXPECT_EQ(progress.progress(), progress.target());
+
+  // The file holds the map as it was when saving started.
+  ASSERT_EQ(load(map_name, load_map), 0);
+  EXPECT_EQ(load_map.regionCount(), saved_region_count);
+  ohmtestutil::compareMaps(load_map, *reference_map, ohmtestutil::kCfCompareExtended);
+}
+
+
+void indexedTest(const char *map_name, unsigned flags, bool compress_blocks = false)
+{
+  int error_code = 0;
+  const double boundary_distance = 2.5;
+  // Use small regions for a reasonable region count.
+  OccupancyMap save_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+
+  ohmgen::boxRoom(save_map, glm::dvec3(-boundary_distance), glm::dvec3(boundary_distance));
+
+  std::vector<const MapChunk *> chunks;
+  if (compress_blocks)
+  {
+    save_map.enumerateRegions(chunks);
+    for (const MapChunk *chunk : chunks)
+    {
+      for (const auto &voxel_block : chunk->voxel_blocks)
+      {
+        voxel_block->compress();
+      }
+    }
+  }
+
+  ProgressDisplay progress;
+  std::cout << "Saving" << std::endl;
+  error_code = saveIndexed(map_name, save_map, &progress, flags);
+  std::cout << std::endl;
+  ASSERT_EQ(error_code, 0);
+  EXPECT_EQ(progress.progress(), save_map.regionCount());
+
+  // Compressed blocks are written as stored, so must not have been uncompressed.
+  for (const MapChunk *chunk : chunks)
+  {
+    for (const auto &voxel_block : chunk->voxel_blocks)
+    {
+      EXPECT_EQ(voxel_block->flags() & VoxelBlock::kFUncompressed, 0u);
+    }
+  }
+
+  std::cout << "Validate header" << std::endl;
+  MapVersion version;
+  size_t region_count = 0;
+  {
+    OccupancyMap header_map(1);
+    error_code = loadHeader(map_name, header_map, &version, &region_count);
+    ASSERT_EQ(error_code, 0);
+    EXPECT_EQ(version, kIndexedVersion);
+    EXPECT_EQ(region_count, save_map.regionCount());
+    EXPECT_TRUE(ohmtestutil::compareLayout(header_map, save_map));
+  }
+
+  std::cout << "Open" << std::endl;
+  {
+    OccupancyMap open_map(1);
+    error_code = openIndexed(map_name, open_map, &version);
+    ASSERT_EQ(error_code, 0);
+    EXPECT_EQ(version, kIndexedVersion);
+
+    // Nothing should be loaded until requested.
+    EXPECT_EQ(open_map.regionCount(), 0u);
+
+    // Compare chunks, which pages in regions via region() lookup.
+    ohmtestutil::compareMaps(open_map, save_map, ohmtestutil::kCfCompareExtended & ~ohmtestutil::kCfGeneral);
+    EXPECT_EQ(open_map.regionCount(), save_map.regionCount());
+
+    // Regions not in the file should still be absent.
+    EXPECT_EQ(open_map.region(glm::i16vec3(1000, 1000, 1000)), nullptr);
+
+    open_map.pageInAllRegions();
+    ohmtestutil::compareMaps(open_map, save_map, ohmtestutil::kCfCompareExtended);
+  }
+
+  std::cout << "Open and page in all" << std::endl;
+  {
+    OccupancyMap open_map(1);
+    error_code = openIndexed(map_name, open_map);
+    ASSERT_EQ(error_code, 0);
+    open_map.pageInAllRegions();
+    EXPECT_EQ(open_map.regionCount(), save_map.regionCount());
+    ohmtestutil::compareMaps(open_map, save_map, ohmtestutil::kCfCompareExtended);
+  }
+
+  std::cout << "Loading" << std::endl;
+  {
+    OccupancyMap load_map(1);
+    progress.reset();
+    error_code = load(map_name, load_map, &progress, &version);
+    std::cout << std::endl;
+    ASSERT_EQ(error_code, 0);
+    EXPECT_EQ(version, kIndexedVersion);
+    ohmtestutil::compareMaps(load_map, save_map, ohmtestutil::kCfCompareExtended);
+  }
+}
+
+
+TEST(Serialisation, Indexed)
+{
+  indexedTest("test-map-indexed.ohm", kImfCompress);
+}
+
+
+TEST(Serialisation, IndexedCompressedBlocks)
+{
+  indexedTest("test-map-indexed-blocks.ohm", kImfCompress, true);
+}
+
+
+TEST(Serialisation, IndexedRaw)
+{
+  indexedTest("test-map-indexed-raw.ohm", kImfRaw);
+}
+
+
+TEST(Serialisation, IndexedParallel)
+{
+  indexedTest("test-map-indexed-parallel.ohm", kImfCompress | kImfParallel);
+}
+
+
+TEST(Serialisation, IndexedSparse)
+{
+  indexedTest("test-map-indexed-sparse.ohm", kImfCompress | kImfSparse);
+}
+
+
+TEST(Serialisation, OpenIndexedLegacy)
+{
+  // openIndexed() falls back to a full load for non-indexed maps.
+  const char *map_name = "test-map-open-legacy.ohm";
+  OccupancyMap save_map(0.25);
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(save(map_name, save_map), 0);
+
+  OccupancyMap open_map(1);
+  MapVersion version;
+  ASSERT_EQ(openIndexed(map_name, open_map, &version), 0);
+  EXPECT_EQ(version, kCurrentVersion);
+  ohmtestutil::compareMaps(open_map, save_map, ohmtestutil::kCfCompareExtended);
+}
+
+
+TEST(Serialisation, Upgrade)
+{
+  const char *map_name = "test-map-upgrade.ohm";
+  const char *upgraded_name = "test-map-upgrade-indexed.ohm";
+  OccupancyMap save_map(0.25);
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(save(map_name, save_map), 0);
+
+  MapUpgradeResult result;
+  ASSERT_EQ(upgradeMap(map_name, upgraded_name, MapUpgradeOptions(), &result), 0);
+  EXPECT_FALSE(result.skipped);
+  EXPECT_TRUE(result.verified);
+  EXPECT_EQ(result.source_version, kCurrentVersion);
+  EXPECT_EQ(result.region_count, save_map.regionCount());
+  EXPECT_EQ(result.mismatched_regions, 0u);
+
+  OccupancyMap load_map(1);
+  MapVersion version;
+  ASSERT_EQ(load(upgraded_name, load_map, nullptr, &version), 0);
+  EXPECT_EQ(version, kIndexedVersion);
+  ohmtestutil::compareMaps(load_map, save_map, ohmtestutil::kCfCompareExtended);
+
+  // A second upgrade skips the already indexed map.
+  ASSERT_EQ(upgradeMap(upgraded_name, upgraded_name, MapUpgradeOptions(), &result), 0);
+  EXPECT_TRUE(result.skipped);
+}
+
+
+TEST(Serialisation, IndexSummary)
+{
+  const char *map_name = "test-map-index-summary.ohm";
+  OccupancyMap save_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(saveIndexed(map_name, save_map, nullptr, kImfCompress), 0);
+
+  OccupancyMap header_map(1);
+  IndexedMapSummary summary;
+  MapVersion version;
+  ASSERT_EQ(loadIndexSummary(map_name, header_map, summary, &version), 0);
+  EXPECT_EQ(version, kIndexedVersion);
+  EXPECT_EQ(header_map.regionCount(), 0u);
+  EXPECT_EQ(header_map.resolution(), save_map.resolution());
+  EXPECT_EQ(summary.region_count, save_map.regionCount());
+
+  // Region extents must bound the voxel extents.
+  glm::dvec3 min_ext(0);
+  glm::dvec3 max_ext(0);
+  Key min_key(Key::kNull);
+  save_map.calculateExtents(&min_ext, &max_ext, &min_key);
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_LE(summary.min_ext[i], min_ext[i]);
+    EXPECT_GE(summary.max_ext[i], max_ext[i]);
+  }
+
+  ASSERT_EQ(summary.layers.size(), 2u);
+  EXPECT_EQ(summary.layers[0].name, save_map.layout().layer(0).name());
+  for (const IndexedLayerSummary &layer : summary.layers)
+  {
+    EXPECT_EQ(layer.raw_size, save_map.regionCount() * save_map.layout()
+                                                          .layer(save_map.layout().layerIndex(layer.name.c_str()))
+                                                          .layerByteSize(save_map.regionVoxelDimensions()));
+    EXPECT_GT(layer.stored_size, 0u);
+    EXPECT_LT(layer.stored_size, layer.raw_size);
+  }
+
+  ASSERT_EQ(summary.density_histogram.size(), unsigned(IndexedMapSummary::kDensityBins));
+  size_t histogram_total = 0;
+  for (size_t count : summary.density_histogram)
+  {
+    histogram_total += count;
+  }
+  EXPECT_EQ(histogram_total, summary.region_count);
+
+  // Only indexed maps have a region index.
+  const char *legacy_name = "test-map-index-summary-legacy.ohm";
+  ASSERT_EQ(save(legacy_name, save_map), 0);
+  EXPECT_EQ(loadIndexSummary(legacy_name, header_map, summary), kSeUnsupportedVersion);
+}
+
+
+TEST(Serialisation, RegionIndex)
+{
+  const char *map_name = "test-map-region-index.ohm";
+  OccupancyMap save_map(0.25, glm::u8vec3(8));
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(saveIndexed(map_name, save_map, nullptr, kImfRaw), 0);
+
+  OccupancyMap header_map(1);
+  IndexedRegionIndex index;
+  ASSERT_EQ(loadRegionIndex(map_name, header_map, index), 0);
+  EXPECT_EQ(header_map.regionCount(), 0u);
+  ASSERT_EQ(index.layers.size(), 1u);
+  EXPECT_EQ(index.layers[0], save_map.layout().layer(save_map.layout().occupancyLayer()).name());
+  ASSERT_EQ(index.regions.size(), save_map.regionCount());
+  ASSERT_EQ(index.touched_times.size(), index.regions.size());
+  ASSERT_EQ(index.blobs.size(), index.regions.size());
+  EXPECT_GT(index.header_size, 0u);
+
+  // Raw blobs must match the region voxel memory.
+  std::ifstream file(map_name, std::ios::binary);
+  ASSERT_TRUE(file.is_open());
+  std::vector<char> blob_data;
+  for (size_t i = 0; i < index.regions.size(); ++i)
+  {
+    const IndexedLayerBlob &blob = index.blob(i, 0);
+    EXPECT_EQ(blob.encoding, kIbeRaw);
+    EXPECT_GE(blob.offset, index.header_size);
+
+    const MapChunk *chunk = save_map.region(index.regions[i]);
+    ASSERT_NE(chunk, nullptr);
+    VoxelBuffer<const VoxelBlock> buffer(chunk->voxel_blocks[save_map.layout().occupancyLayer()]);
+    ASSERT_EQ(blob.stored_size, buffer.voxelMemorySize());
+
+    blob_data.resize(blob.stored_size);
+    file.seekg(std::streamoff(blob.offset));
+    file.read(blob_data.data(), std::streamsize(blob_data.size()));
+    ASSERT_TRUE(file.good());
+    EXPECT_EQ(memcmp(blob_data.data(), buffer.voxelMemory(), blob_data.size()), 0);
+  }
+
+  // Only indexed maps have a region index.
+  const char *legacy_name = "test-map-region-index-legacy.ohm";
+  ASSERT_EQ(save(legacy_name, save_map), 0);
+  EXPECT_EQ(loadRegionIndex(legacy_name, header_map, index), kSeUnsupportedVersion);
+}
+
+
+/// Validate a partial load of @p map_name against the @p save_map . Loaded regions must match @p region_filter and
+/// only the occupancy layer is loaded.
+void validatePartialLoad(const char *map_name, const OccupancyMap &save_map, const CopyChunkFilter &region_filter)
+{
+  OccupancyMap load_map(1);
+  const auto layer_filter = [](const std::string &name) { return name == default_layer::occupancyLayerName(); };
+  ASSERT_EQ(load(map_name, load_map, region_filter, layer_filter), 0);
+  EXPECT_EQ(load_map.layout().layerCount(), save_map.layout().layerCount());
+
+  std::vector<const MapChunk *> save_chunks;
+  save_map.enumerateRegions(save_chunks);
+  size_t expected_count = 0;
+  for (const MapChunk *save_chunk : save_chunks)
+  {
+    const MapChunk *load_chunk = load_map.region(save_chunk->region.coord);
+    if (!region_filter(*save_chunk))
+    {
+      EXPECT_EQ(load_chunk, nullptr);
+      continue;
+    }
+
+    ++expected_count;
+    ASSERT_NE(load_chunk, nullptr);
+  }
+  EXPECT_GT(expected_count, 0u);
+  EXPECT_LT(expected_count, save_chunks.size());
+  EXPECT_EQ(load_map.regionCount(), expected_count);
+
+  Voxel<const float> save_occupancy(&save_map, save_map.layout().occupancyLayer());
+  Voxel<const float> load_occupancy(&load_map, load_map.layout().occupancyLayer());
+  Voxel<const VoxelMean> load_mean(&load_map, load_map.layout().meanLayer());
+  ASSERT_TRUE(load_mean.isLayerValid());
+  for (auto iter = load_map.begin(); iter != load_map.end(); ++iter)
+  {
+    save_occupancy.setKey(*iter);
+    load_occupancy.setKey(iter);
+    load_mean.setKey(iter);
+    ASSERT_TRUE(save_occupancy.isValid());
+    EXPECT_EQ(load_occupancy.data(), save_occupancy.data());
+    // Unselected layers are cleared.
+    EXPECT_EQ(load_mean.data().count, 0u);
+  }
+}
+
+
+TEST(Serialisation, PartialLoad)
+{
+  const char *indexed_name = "test-map-partial-indexed.ohm";
+  const char *legacy_name = "test-map-partial-legacy.ohm";
+  OccupancyMap save_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(saveIndexed(indexed_name, save_map, nullptr, kImfCompress), 0);
+  ASSERT_EQ(save(legacy_name, save_map), 0);
+
+  // Region set selection.
+  std::vector<const MapChunk *> save_chunks;
+  save_map.enumerateRegions(save_chunks);
+  ASSERT_GT(save_chunks.size(), 2u);
+  const std::vector<glm::i16vec3> regions = { save_chunks[0]->region.coord, save_chunks[1]->region.coord };
+  const auto region_set_filter = [&regions](const MapChunk &chunk) {
+    return std::find(regions.begin(), regions.end(), chunk.region.coord) != regions.end();
+  };
+
+  const Aabb bounds(glm::dvec3(0.5), glm::dvec3(3.0));
+  for (const char *map_name : { indexed_name, legacy_name })
+  {
+    validatePartialLoad(map_name, save_map, copyFilterExtents(bounds.minExtents(), bounds.maxExtents()));
+    validatePartialLoad(map_name, save_map, region_set_filter);
+
+    // Convenience overloads.
+    OccupancyMap aabb_map(1);
+    ASSERT_EQ(load(map_name, aabb_map, bounds), 0);
+    OccupancyMap region_map(1);
+    ASSERT_EQ(load(map_name, region_map, regions), 0);
+    EXPECT_EQ(region_map.regionCount(), regions.size());
+  }
+}
+
+
+/// Validate @p load_map has deferred the mean layer of each region and matches @p save_map once loaded.
+void validateLazyLayers(OccupancyMap &load_map, const OccupancyMap &save_map)
+{
+  const int mean_layer = load_map.layout().meanLayer();
+  ASSERT_GE(mean_layer, 0);
+
+  std::vector<const MapChunk *> save_chunks;
+  save_map.enumerateRegions(save_chunks);
+  ASSERT_FALSE(save_chunks.empty());
+  Voxel<const VoxelMean> save_mean(&save_map, save_map.layout().meanLayer());
+  Voxel<const float> save_occupancy(&save_map, save_map.layout().occupancyLayer());
+  for (const MapChunk *save_chunk : save_chunks)
+  {
+    MapChunk *load_chunk = load_map.region(save_chunk->region.coord);
+    ASSERT_NE(load_chunk, nullptr);
+    EXPECT_FALSE(load_chunk->voxel_blocks[load_map.layout().occupancyLayer()]->flags() & VoxelBlock::kFDeferred);
+    EXPECT_TRUE(load_chunk->voxel_blocks[mean_layer]->flags() & VoxelBlock::kFDeferred);
+
+    // Access loads the mean layer.
+    Voxel<const VoxelMean> load_mean(&load_map, mean_layer);
+    Voxel<const float> load_occupancy(&load_map, load_map.layout().occupancyLayer());
+    for (int i = 0; i < int(load_map.regionVoxelVolume()); ++i)
+    {
+      const Key key =
+        MapChunk::keyForIndex(i, glm::ivec3(load_map.regionVoxelDimensions()), load_chunk->region.coord);
+      load_mean.setKey(key, load_chunk);
+      load_occupancy.setKey(key, load_chunk);
+      save_mean.setKey(key);
+      save_occupancy.setKey(key);
+      EXPECT_EQ(load_occupancy.data(), save_occupancy.data());
+      EXPECT_EQ(load_mean.data().coord, save_mean.data().coord);
+      EXPECT_EQ(load_mean.data().count, save_mean.data().count);
+    }
+    EXPECT_FALSE(load_chunk->voxel_blocks[mean_layer]->flags() & VoxelBlock::kFDeferred);
+  }
+}
+
+
+TEST(Serialisation, LazyLayers)
+{
+  const char *map_name = "test-map-lazy-layers.ohm";
+  OccupancyMap save_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  {
+    Voxel<VoxelMean> mean(&save_map, save_map.layout().meanLayer());
+    Voxel<const float> occupancy(&save_map, save_map.layout().occupancyLayer());
+    for (auto iter = save_map.begin(); iter != save_map.end(); ++iter)
+    {
+      occupancy.setKey(iter);
+      if (isOccupied(occupancy))
+      {
+        mean.setKey(iter);
+        setPositionSafe(mean, save_map.voxelCentreGlobal(*iter) + glm::dvec3(0.25 * save_map.resolution()), 1);
+      }
+    }
+  }
+  ASSERT_EQ(saveIndexed(map_name, save_map, nullptr, kImfCompress), 0);
+
+  const auto occupancy_filter = [](const std::string &name) { return name == default_layer::occupancyLayerName(); };
+
+  OccupancyMap load_map(1);
+  ASSERT_EQ(loadLazy(map_name, load_map, occupancy_filter), 0);
+  EXPECT_EQ(load_map.regionCount(), save_map.regionCount());
+  validateLazyLayers(load_map, save_map);
+
+  // Regions paged in on demand defer in the same way, including after the file is released.
+  OccupancyMap open_map(1);
+  ASSERT_EQ(openIndexed(map_name, open_map, occupancy_filter), 0);
+  EXPECT_EQ(open_map.regionCount(), 0u);
+  open_map.pageInAllRegions();
+  validateLazyLayers(open_map, save_map);
+}
+
+
+TEST(Serialisation, StreamCloud)
+{
+  const char *map_name = "test-map-stream-cloud.ohm";
+  OccupancyMap save_map(0.25, glm::u8vec3(8));
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(saveIndexed(map_name, save_map, nullptr, kImfCompress), 0);
+
+  const uint64_t expected_count = ohmtools::saveCloud("test-map-stream-cloud-full.ply", save_map);
+  EXPECT_GT(expected_count, 0u);
+
+  OccupancyMap open_map(1);
+  ASSERT_EQ(openIndexed(map_name, open_map), 0);
+  std::vector<glm::i16vec3> region_keys;
+  EXPECT_EQ(open_map.enumerateIndexedRegions(region_keys), save_map.regionCount());
+
+  // Use a small window to stream over several windows.
+  ohmtools::SaveCloudOptions opt;
+  opt.region_window = 3;
+  size_t last_progress = 0;
+  const uint64_t streamed_count = ohmtools::streamCloud(
+    "test-map-stream-cloud.ply", open_map, opt, [&last_progress](size_t progress, size_t target) {
+      EXPECT_GT(progress, last_progress);
+      EXPECT_LE(progress, target);
+      last_progress = progress;
+    });
+  EXPECT_EQ(streamed_count, expected_count);
+  EXPECT_EQ(last_progress, region_keys.size());
+
+  // Streamed regions are evicted.
+  EXPECT_EQ(open_map.regionCount(), 0u);
+}
+
+
+TEST(Serialisation, StreamClouds)
+{
+  const char *map_name = "test-map-stream-clouds.ohm";
+  OccupancyMap save_map(0.25, glm::u8vec3(8));
+  ohmgen::fillMapWithEmptySpace(save_map, -10, -10, -10, 10, 10, 10);
+  ohmgen::boxRoom(save_map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  ASSERT_EQ(saveIndexed(map_name, save_map, nullptr, kImfCompress), 0);
+
+  // Several exports from one pass, each matching the single export.
+  std::vector<ohmtools::CloudExport> exports(3);
+  exports[0].file_name = "test-map-stream-clouds-occupied.ply";
+  exports[1].file_name = "test-map-stream-clouds-free.ply";
+  exports[1].options.export_free = true;
+  exports[1].options.allow_default_colour_selection = false;
+  // No traversal layer: skipped.
+  exports[2].file_name = "test-map-stream-clouds-density.ply";
+  exports[2].type = ohmtools::CloudExportType::kDensity;
+
+  const uint64_t occupied_count = ohmtools::saveCloud("test-map-stream-clouds-full.ply", save_map);
+  const uint64_t free_count = ohmtools::saveCloud("test-map-stream-clouds-full-free.ply", save_map, exports[1].options);
+  EXPECT_GT(occupied_count, 0u);
+  EXPECT_GT(free_count, occupied_count);
+
+  EXPECT_EQ(ohmtools::saveClouds(exports, save_map), occupied_count + free_count);
+  EXPECT_EQ(exports[0].point_count, occupied_count);
+  EXPECT_EQ(exports[1].point_count, free_count);
+  EXPECT_EQ(exports[2].point_count, 0u);
+
+  OccupancyMap open_map(1);
+  ASSERT_EQ(openIndexed(map_name, open_map), 0);
+  exports[0].options.region_window = 3;
+  EXPECT_EQ(ohmtools::streamClouds(exports, open_map), occupied_count + free_count);
+  EXPECT_EQ(exports[0].point_count, occupied_count);
+  EXPECT_EQ(exports[1].point_count, free_count);
+  EXPECT_EQ(open_map.regionCount(), 0u);
+}
+
+
+TEST(Serialisation, AsyncStream)
+{
+  // Validate the asynchronous stream buffering with content spanning many buffers, patching by seek and appending.
+  const char *file_name = "test-async-stream.bin";
+  std::vector<uint32_t> content(1024u * 1024u);
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  for (auto &value : content)
+  {
+    value = rand_engine() % 100u;  // NOLINT(readability-magic-numbers)
+  }
+  const auto content_bytes = unsigned(content.size() * sizeof(content[0]));
+
+  uint64_t end_pos = 0;
+  {
+    OutputStream out(file_name);
+    ASSERT_TRUE(out.isOpen());
+    const uint64_t placeholder = 0;
+    EXPECT_EQ(out.writeUncompressed(&placeholder, unsigned(sizeof(placeholder))), sizeof(placeholder));
+    EXPECT_EQ(out.writeUncompressed(content.data(), content_bytes), content_bytes);
+    end_pos = out.tell();
+    EXPECT_EQ(end_pos, sizeof(placeholder) + content_bytes);
+    out.seek(0);
+    EXPECT_EQ(out.writeUncompressed(&end_pos, unsigned(sizeof(end_pos))), sizeof(end_pos));
+  }
+
+  {
+    OutputStream out(file_name, kSfAppend | kSfCompress);
+    ASSERT_TRUE(out.isOpen());
+    EXPECT_EQ(out.tell(), end_pos);
+    EXPECT_EQ(out.write(content.data(), content_bytes), content_bytes);
+  }
+
+  InputStream in(file_name);
+  ASSERT_TRUE(in.isOpen());
+  uint64_t read_end_pos = 0;
+  EXPECT_EQ(in.readRaw(&read_end_pos, unsigned(sizeof(read_end_pos))), sizeof(read_end_pos));
+  EXPECT_EQ(read_end_pos, end_pos);
+
+  std::vector<uint32_t> read_content(content.size());
+  EXPECT_EQ(in.readRaw(read_content.data(), content_bytes), content_bytes);
+  EXPECT_EQ(read_content, content);
+  EXPECT_EQ(in.tell(), end_pos);
+
+  in.setCompressedFlag();
+  std::fill(read_content.begin(), read_content.end(), 0u);
+  EXPECT_EQ(in.read(read_content.data(), content_bytes), content_bytes);
+  EXPECT_EQ(read_content, content);
+  EXPECT_EQ(in.read(read_content.data(), 1u), 0u);
+
+  // Seeking discards the read ahead.
+  in.seek(sizeof(read_end_pos));
+  uint32_t first = 0;
+  EXPECT_EQ(in.readRaw(&first, unsigned(sizeof(first))), sizeof(first));
+  EXPECT_EQ(first, content.front());
+}
+
+
+/// Build a base map and a journal of two deltas for the Serialisation.Delta tests. Returns the last delta stamp.
+uint64_t buildDeltaJournal(OccupancyMap &map, const char *base_name, const char *journal_name)
+{
+  std::remove(journal_name);
+  ohmgen::boxRoom(map, glm::dvec3(-2.5), glm::dvec3(2.5));
+  EXPECT_EQ(save(base_name, map), 0);
+
+  uint64_t stamp = map.stamp();
+  for (int i = 0; i < 2; ++i)
+  {
+    // Touch a line of voxels, adding new regions beyond the room and changing some existing ones.
+    for (double x = -4.0; x <= 4.0; x += map.resolution())
+    {
+      integrateHit(map, map.voxelKey(glm::dvec3(x, 0.5 * i, 0.1)));
+    }
+
+    std::vector<std::pair<uint64_t, glm::i16vec3>> dirty_regions;
+    map.collectDirtyRegions(stamp, dirty_regions);
+    EXPECT_GT(dirty_regions.size(), 0u);
+    EXPECT_LT(dirty_regions.size(), map.regionCount());
+
+    ProgressDisplay progress;
+    EXPECT_EQ(saveDelta(journal_name, map, stamp, &progress, &stamp), 0);
+    EXPECT_EQ(progress.target(), dirty_regions.size());
+    EXPECT_EQ(stamp, map.stamp());
+  }
+
+  return stamp;
+}
+
+
+TEST(Serialisation, Delta)
+{
+  const char *base_name = "test-map-delta-base.ohm";
+  const char *journal_name = "test-map-delta.ohmj";
+  OccupancyMap save_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+  uint64_t stamp = buildDeltaJournal(save_map, base_name, journal_name);
+
+  // No changes: commits an empty delta.
+  ASSERT_EQ(saveDelta(journal_name, save_map, stamp, nullptr, &stamp), 0);
+
+  OccupancyMap load_map(1);
+  ASSERT_EQ(load(base_name, load_map), 0);
+  uint64_t replay_stamp = 0;
+  ASSERT_EQ(loadDelta(journal_name, load_map, nullptr, &replay_stamp), 0);
+  EXPECT_EQ(replay_stamp, stamp);
+  EXPECT_EQ(load_map.stamp(), save_map.stamp());
+  ohmtestutil::compareMaps(load_map, save_map, ohmtestutil::kCfCompareExtended);
+
+  // The journal must match the map.
+  OccupancyMap other_map(0.5, glm::u8vec3(8), MapFlag::kVoxelMean);
+  EXPECT_EQ(saveDelta(journal_name, other_map, 0), kSeJournalMismatch);
+  EXPECT_EQ(loadDelta(journal_name, other_map), kSeJournalMismatch);
+
+  // Region voxels would be misinterpreted with a different voxel order or origin.
+  OccupancyMap morton_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean | MapFlag::kVoxelOrderMorton);
+  EXPECT_EQ(saveDelta(journal_name, morton_map, 0), kSeJournalMismatch);
+  EXPECT_EQ(loadDelta(journal_name, morton_map), kSeJournalMismatch);
+  OccupancyMap offset_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+  offset_map.setOrigin(glm::dvec3(1.0, 0.0, 0.0));
+  EXPECT_EQ(saveDelta(journal_name, offset_map, 0), kSeJournalMismatch);
+  EXPECT_EQ(loadDelta(journal_name, offset_map), kSeJournalMismatch);
+}
+
+
+TEST(Serialisation, DeltaTruncated)
+{
+  const char *base_name = "test-map-delta-truncated-base.ohm";
+  const char *journal_name = "test-map-delta-truncated.ohmj";
+  OccupancyMap save_map(0.25, glm::u8vec3(8), MapFlag::kVoxelMean);
+  const uint64_t stamp = buildDeltaJournal(save_map, base_name, journal_name);
+
+  // Simulate an interrupted write of a third delta by appending a partial record.
+  {
+    std::ofstream journal(journal_name, std::ios::binary | std::ios::app);
+    const char partial[] = "partial";
+    journal.write(partial, sizeof(partial));
+  }
+
+  // Replay recovers both complete deltas.
+  OccupancyMap load_map(1);
+  ASSERT_EQ(load(base_name, load_map), 0);
+  uint64_t replay_stamp = 0;
+  ASSERT_EQ(loadDelta(journal_name, load_map, nullptr, &replay_stamp), 0);
+  EXPECT_EQ(replay_stamp, stamp);
+  ohmtestutil::compareMaps(load_map, save_map, ohmtestutil::kCfCompareExtended);
+
+  // Appending is refused.
+  EXPECT_EQ(saveDelta(journal_name, save_map, stamp), kSeJournalCorrupt);
+}
+
+
 // Legacy code used to generate the test map for Serialisation.Upgrade tests.
 void cubicRoomLegacy(OccupancyMap &map, float boundary_range, int voxel_step)
 {
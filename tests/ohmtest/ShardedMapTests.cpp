@@ -0,0 +1,194 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/Key.h>
+#include <ohm/MapChunk.h>
+#include <ohm/NearestNeighbours.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/ShardedMap.h>
+#include <ohm/VoxelOccupancy.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+namespace shardedmaptests
+{
+const double kSampleRange = 8.0;
+
+/// Generate rays from the origin to points evenly spread over a sphere of @c kSampleRange , scaled by @p scale .
+void generateRays(std::vector<glm::dvec3> &rays, unsigned ray_count, double scale = 1.0)
+{
+  // Fibonacci sphere.
+  const double golden_angle = glm::pi<double>() * (3.0 - std::sqrt(5.0));
+  rays.clear();
+  for (unsigned i = 0; i < ray_count; ++i)
+  {
+    const double z = 1.0 - 2.0 * (double(i) + 0.5) / double(ray_count);
+    const double radius = std::sqrt(1.0 - z * z);
+    const double theta = golden_angle * double(i);
+    const glm::dvec3 dir(radius * std::cos(theta), radius * std::sin(theta), z);
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(dir * kSampleRange * scale);
+  }
+}
+
+
+/// Validate that every region in each shard lies in the shard's key range.
+void validateOwnership(const ohm::ShardedMap &sharded)
+{
+  for (unsigned i = 0; i < sharded.shardCount(); ++i)
+  {
+    std::vector<const ohm::MapChunk *> chunks;
+    sharded.shard(i).enumerateRegions(chunks);
+    for (const ohm::MapChunk *chunk : chunks)
+    {
+      EXPECT_EQ(sharded.shardIndex(chunk->region.coord), i);
+    }
+  }
+}
+
+
+/// Validate the occupancy of each sample point in @p rays against the @p reference map.
+void validateSamples(const ohm::ShardedMap &sharded, const ohm::OccupancyMap &reference,
+                     const std::vector<glm::dvec3> &rays)
+{
+  std::vector<glm::dvec3> samples;
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    samples.emplace_back(rays[i]);
+  }
+
+  std::vector<float> values(samples.size());
+  sharded.occupancy(samples.data(), samples.size(), values.data());
+
+  ohm::Voxel<const float> voxel(&reference, reference.layout().occupancyLayer());
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    voxel.setKey(reference.voxelKey(samples[i]));
+    float expected = ohm::unobservedOccupancyValue();
+    if (voxel.isValid())
+    {
+      voxel.read(&expected);
+    }
+    // Values may differ slightly as the update order differs across shards, but not the occupancy state.
+    EXPECT_EQ(ohm::isOccupied(values[i], reference), ohm::isOccupied(expected, reference));
+    EXPECT_TRUE(ohm::isOccupied(values[i], reference));
+  }
+}
+
+
+TEST(ShardedMap, Integrate)
+{
+  ohm::OccupancyMap reference(0.1);
+  ohm::ShardedMap sharded(reference, 3, 0, 2);
+
+  ASSERT_EQ(sharded.shardCount(), 3u);
+  ASSERT_EQ(sharded.boundaries().size(), 2u);
+  EXPECT_EQ(sharded.boundaries()[0], -1);
+  EXPECT_EQ(sharded.boundaries()[1], 1);
+
+  std::vector<glm::dvec3> rays;
+  generateRays(rays, 1000);
+
+  ohm::RayMapperOccupancy mapper(&reference);
+  mapper.integrateRays(rays.data(), rays.size());
+  EXPECT_GE(sharded.integrateRays(rays.data(), rays.size()), rays.size() / 2);
+
+  // Rays span all shards.
+  for (unsigned i = 0; i < sharded.shardCount(); ++i)
+  {
+    EXPECT_GT(sharded.shard(i).regionCount(), 0u);
+  }
+  EXPECT_EQ(sharded.regionCount(), reference.regionCount());
+
+  validateOwnership(sharded);
+  validateSamples(sharded, reference, rays);
+}
+
+
+TEST(ShardedMap, Query)
+{
+  ohm::OccupancyMap reference(0.1);
+  ohm::ShardedMap sharded(reference, 4, 0, 1);
+
+  std::vector<glm::dvec3> rays;
+  generateRays(rays, 500);
+
+  ohm::RayMapperOccupancy mapper(&reference);
+  mapper.integrateRays(rays.data(), rays.size());
+  sharded.integrateRays(rays.data(), rays.size());
+
+  // Query beyond the samples. Every ray should stop at its sample.
+  std::vector<glm::dvec3> query_rays;
+  generateRays(query_rays, 500, 1.5);
+
+  std::vector<ohm::ShardedRayResult> results;
+  sharded.raysQuery(query_rays.data(), query_rays.size(), results);
+  ASSERT_EQ(results.size(), query_rays.size() / 2);
+  for (const ohm::ShardedRayResult &result : results)
+  {
+    EXPECT_EQ(result.terminal_type, ohm::kOccupied);
+    EXPECT_NEAR(result.range, kSampleRange, 2.0 * reference.resolution());
+  }
+
+  // Search the whole sample sphere, which spans every shard.
+  const float search_radius = float(kSampleRange + 1.0);
+  ohm::NearestNeighbours nn(reference, glm::dvec3(0.0), search_radius, 0);
+  ASSERT_TRUE(nn.execute());
+
+  std::vector<ohm::Key> keys;
+  std::vector<double> ranges;
+  EXPECT_EQ(sharded.nearestNeighbours(glm::dvec3(0.0), search_radius, keys, ranges, 0), nn.numberOfResults());
+  ASSERT_EQ(keys.size(), ranges.size());
+  for (size_t i = 1; i < ranges.size(); ++i)
+  {
+    EXPECT_LE(ranges[i - 1], ranges[i]);
+  }
+}
+
+
+TEST(ShardedMap, Rebalance)
+{
+  ohm::OccupancyMap reference(0.1);
+  ohm::ShardedMap sharded(reference, 3, 0, 2);
+
+  std::vector<glm::dvec3> rays;
+  generateRays(rays, 1000);
+
+  ohm::RayMapperOccupancy mapper(&reference);
+  mapper.integrateRays(rays.data(), rays.size());
+  sharded.integrateRays(rays.data(), rays.size());
+
+  const size_t region_count = sharded.regionCount();
+
+  // Invalid boundaries: wrong count and unsorted.
+  EXPECT_EQ(sharded.setBoundaries({ 0 }), -1);
+  EXPECT_EQ(sharded.setBoundaries({ 1, -1 }), -1);
+
+  // Shift all regions to the last shard and back again.
+  EXPECT_GT(sharded.setBoundaries({ -100, -99 }), 0);
+  EXPECT_EQ(sharded.shard(0).regionCount(), 0u);
+  EXPECT_EQ(sharded.shard(1).regionCount(), 0u);
+  EXPECT_EQ(sharded.regionCount(), region_count);
+  validateOwnership(sharded);
+  validateSamples(sharded, reference, rays);
+
+  EXPECT_GT(sharded.setBoundaries({ -2, 0 }), 0);
+  EXPECT_EQ(sharded.regionCount(), region_count);
+  validateOwnership(sharded);
+  validateSamples(sharded, reference, rays);
+
+  // Unchanged boundaries move nothing.
+  EXPECT_EQ(sharded.setBoundaries({ -2, 0 }), 0);
+}
+}  // namespace shardedmaptests
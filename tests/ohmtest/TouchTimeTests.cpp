@@ -14,6 +14,8 @@
 #include <ohm/RayMapperNdt.h>
 #include <ohm/RayMapperOccupancy.h>
 #include <ohm/Voxel.h>
+#include <ohm/VoxelIncident.h>
+#include <ohm/VoxelTouchIncident.h>
 #include <ohm/VoxelTouchTime.h>
 
 #include <glm/gtx/norm.hpp>
@@ -92,4 +94,59 @@ TEST(TouchTime, WithNdt)
   ohm::RayMapperNdt mapper(&ndt_map);
   testTouchTime(map, mapper);
 }
+
+TEST(TouchTime, PackedIncident)
+{
+  // Validate the packed touch time and incident normal layer matches the individual layers.
+  ohm::OccupancyMap separate_map(0.1f, ohm::MapFlag::kVoxelMean | ohm::MapFlag::kTouchTime |
+                                         ohm::MapFlag::kIncidentNormal);
+  ohm::OccupancyMap packed_map(0.1f, ohm::MapFlag::kVoxelMean | ohm::MapFlag::kTouchIncident);
+  ohm::RayMapperOccupancy separate_mapper(&separate_map);
+  ohm::RayMapperOccupancy packed_mapper(&packed_map);
+
+  ASSERT_TRUE(packed_map.touchIncidentEnabled());
+  ASSERT_TRUE(packed_mapper.valid());
+
+  const unsigned ray_count = 1000u;
+  const double time_base = 1000.0;
+  const double time_step = 0.5;
+  std::vector<glm::dvec3> rays;
+  std::vector<double> timestamps;
+  std::default_random_engine rng(1153297050u);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  for (unsigned r = 0; r < ray_count; ++r)
+  {
+    rays.emplace_back(glm::dvec3(0));
+    rays.emplace_back(glm::dvec3(uniform(rng), uniform(rng), uniform(rng)));
+    timestamps.emplace_back(time_base + r * time_step);
+  }
+
+  separate_mapper.integrateRays(rays.data(), rays.size(), nullptr, timestamps.data(), ohm::kRfDefault);
+  packed_mapper.integrateRays(rays.data(), rays.size(), nullptr, timestamps.data(), ohm::kRfDefault);
+
+  ohm::Voxel<const uint32_t> time_voxel(&separate_map,
+                                        separate_map.layout().layerIndex(ohm::default_layer::touchTimeLayerName()));
+  ohm::Voxel<const uint32_t> incident_voxel(
+    &separate_map, separate_map.layout().layerIndex(ohm::default_layer::incidentNormalLayerName()));
+  ohm::Voxel<const ohm::VoxelTouchIncident> packed_voxel(
+    &packed_map, packed_map.layout().layerIndex(ohm::default_layer::touchIncidentLayerName()));
+  ASSERT_TRUE(time_voxel.isLayerValid());
+  ASSERT_TRUE(incident_voxel.isLayerValid());
+  ASSERT_TRUE(packed_voxel.isLayerValid());
+
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    const ohm::Key key = separate_map.voxelKey(rays[i]);
+    time_voxel.setKey(key);
+    incident_voxel.setKey(key);
+    packed_voxel.setKey(key);
+    ASSERT_TRUE(packed_voxel.isValid());
+
+    const ohm::VoxelTouchIncident packed = packed_voxel.data();
+    EXPECT_EQ(packed.touch_time, time_voxel.data());
+    EXPECT_EQ(packed.packed_normal, incident_voxel.data());
+    EXPECT_NE(packed.packed_normal, 0u);
+  }
+}
 }  // namespace touchtime
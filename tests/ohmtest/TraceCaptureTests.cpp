@@ -0,0 +1,125 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/Key.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/RayMapperTrace.h>
+#include <ohm/TraceCapture.h>
+#include <ohm/VoxelData.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace tracecapture
+{
+/// Generate a single ray for @p batch . Rays for different batches do not share voxels.
+std::vector<glm::dvec3> batchRays(unsigned batch)
+{
+  return { glm::dvec3(0, 0.5 * batch, 0), glm::dvec3(1, 0.5 * batch, 0) };
+}
+
+
+TEST(TraceCapture, Sampled)
+{
+  const char *capture_name = "test-trace-sampled.ohmtrace";
+  ohm::OccupancyMap map(0.1);
+  ohm::RayMapperOccupancy mapper(&map);
+  ohm::RayMapperTrace trace(&map, &mapper);
+
+  trace.setLiveEmission(false);
+  trace.setBatchInterval(2);
+  ASSERT_TRUE(trace.openCapture(capture_name));
+
+  const unsigned batch_count = 4;
+  for (unsigned i = 0; i < batch_count; ++i)
+  {
+    const std::vector<glm::dvec3> rays = batchRays(i);
+    trace.integrateRays(rays.data(), rays.size(), nullptr, nullptr, ohm::kRfDefault);
+  }
+  trace.closeCapture();
+  EXPECT_EQ(trace.batchCount(), batch_count);
+
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  ASSERT_TRUE(occupancy.isLayerValid());
+
+  std::vector<uint64_t> batch_indices;
+  ohm::TraceCaptureInfo info;
+  const bool read_ok = ohm::TraceCaptureReader::read(
+    capture_name,
+    [&](const ohm::TraceCaptureBatch &batch) {
+      batch_indices.emplace_back(batch.batch_index);
+      const std::vector<glm::dvec3> rays = batchRays(unsigned(batch.batch_index));
+      EXPECT_EQ(batch.rays, rays);
+      EXPECT_FALSE(batch.voxels.empty());
+
+      // Validate the sample voxel. Batches do not overlap so the map still contains the captured values.
+      const ohm::Key sample_key = map.voxelKey(rays[1]);
+      bool found_sample = false;
+      for (const ohm::TraceCaptureVoxel &voxel : batch.voxels)
+      {
+        occupancy.setKey(voxel.key);
+        float map_value = 0;
+        occupancy.read(&map_value);
+        EXPECT_EQ(voxel.occupancy, map_value);
+        EXPECT_NE(voxel.type, voxel.initial_type);
+        if (voxel.key == sample_key)
+        {
+          found_sample = true;
+          EXPECT_EQ(voxel.type, ohm::kOccupied);
+        }
+      }
+      EXPECT_TRUE(found_sample);
+      return true;
+    },
+    &info);
+  occupancy.reset();
+
+  ASSERT_TRUE(read_ok);
+  EXPECT_TRUE(info.with_rays);
+  EXPECT_EQ(info.resolution, map.resolution());
+  EXPECT_EQ(batch_indices, std::vector<uint64_t>({ 0, 2 }));
+}
+
+
+TEST(TraceCapture, RegionOfInterest)
+{
+  const char *capture_name = "test-trace-roi.ohmtrace";
+  ohm::OccupancyMap map(0.1);
+  ohm::RayMapperOccupancy mapper(&map);
+  ohm::RayMapperTrace trace(&map, &mapper);
+
+  trace.setLiveEmission(false);
+  // Only trace the second batch, clipping the ray to the first half.
+  trace.setRegionOfInterest(ohm::Aabb(glm::dvec3(-0.1, 0.4, -0.1), glm::dvec3(0.5, 0.6, 0.1)));
+  ASSERT_TRUE(trace.openCapture(capture_name, false));
+
+  for (unsigned i = 0; i < 2; ++i)
+  {
+    const std::vector<glm::dvec3> rays = batchRays(i);
+    trace.integrateRays(rays.data(), rays.size(), nullptr, nullptr, ohm::kRfDefault);
+  }
+  trace.closeCapture();
+
+  std::vector<ohm::TraceCaptureBatch> batches;
+  ASSERT_TRUE(ohm::TraceCaptureReader::read(capture_name, [&](const ohm::TraceCaptureBatch &batch) {
+    batches.emplace_back(batch);
+    return true;
+  }));
+
+  ASSERT_EQ(batches.size(), 1u);
+  EXPECT_EQ(batches[0].batch_index, 1u);
+  EXPECT_TRUE(batches[0].rays.empty());
+  for (const ohm::TraceCaptureVoxel &voxel : batches[0].voxels)
+  {
+    // Clipped to the ROI, so all changes are free.
+    EXPECT_EQ(voxel.type, ohm::kFree);
+    EXPECT_LE(map.voxelCentreGlobal(voxel.key).x, 0.5 + map.resolution());
+  }
+}
+}  // namespace tracecapture
@@ -0,0 +1,101 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohmutil/TrajectoryIndex.h>
+
+#include <gtest/gtest.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace trajectoryindextests
+{
+TEST(TrajectoryIndex, Order)
+{
+  ohm::TrajectoryIndex trajectory;
+  EXPECT_TRUE(trajectory.add(1.0, glm::dvec3(0.0)));
+  EXPECT_TRUE(trajectory.add(1.0, glm::dvec3(1.0)));
+  EXPECT_FALSE(trajectory.add(0.5, glm::dvec3(2.0)));
+  EXPECT_TRUE(trajectory.add(2.0, glm::dvec3(3.0)));
+  EXPECT_EQ(trajectory.count(), 3u);
+
+  glm::dvec3 position;
+  EXPECT_FALSE(trajectory.pose(0.5, position));
+  EXPECT_FALSE(trajectory.pose(2.5, position));
+  ASSERT_TRUE(trajectory.pose(1.5, position));
+  EXPECT_NEAR(position.x, 2.0, 1e-9);
+}
+
+
+TEST(TrajectoryIndex, Lookup)
+{
+  // Build a trajectory with irregular time steps, then query unordered times against a brute force search.
+  std::mt19937 rng(1234u);
+  std::uniform_real_distribution<double> step_rand(0.001, 0.2);
+  ohm::TrajectoryIndex trajectory;
+  double time = 10.0;
+  for (unsigned i = 0; i < 1000; ++i)
+  {
+    const double angle = 0.001 * double(i);
+    trajectory.add(time, glm::dvec3(time, 2.0 * time, 0.0), glm::angleAxis(angle, glm::dvec3(0, 0, 1)));
+    // Include some duplicate timestamps.
+    time += (i % 97 == 0) ? 0.0 : step_rand(rng);
+  }
+  trajectory.buildIndex();
+
+  std::uniform_real_distribution<double> time_rand(trajectory.startTime(), trajectory.endTime());
+  for (unsigned i = 0; i < 10000; ++i)
+  {
+    const double query_time = (i == 0) ? trajectory.startTime() : (i == 1) ? trajectory.endTime() : time_rand(rng);
+    const size_t segment = trajectory.findSegment(query_time);
+    ASSERT_LT(segment + 1, trajectory.count());
+    EXPECT_LE(trajectory.times()[segment], query_time);
+    EXPECT_GE(trajectory.times()[segment + 1], query_time);
+
+    // Brute force reference.
+    const double *times_end = trajectory.times() + trajectory.count();
+    const size_t expected =
+      std::min<size_t>(std::upper_bound(trajectory.times(), times_end, query_time) - trajectory.times() - 1,
+                       trajectory.count() - 2);
+    EXPECT_EQ(trajectory.times()[segment], trajectory.times()[expected]);
+
+    glm::dvec3 position;
+    glm::dquat rotation;
+    ASSERT_TRUE(trajectory.pose(query_time, position, rotation));
+    EXPECT_NEAR(position.x, query_time, 1e-9);
+    EXPECT_NEAR(position.y, 2.0 * query_time, 1e-9);
+
+    // The rotation must lie between the segment end rotations.
+    const glm::dvec3 heading = rotation * glm::dvec3(1, 0, 0);
+    const glm::dvec3 heading0 = trajectory.rotations()[segment] * glm::dvec3(1, 0, 0);
+    const glm::dvec3 heading1 = trajectory.rotations()[segment + 1] * glm::dvec3(1, 0, 0);
+    const double angle = std::atan2(heading.y, heading.x);
+    EXPECT_GE(angle, std::atan2(heading0.y, heading0.x) - 1e-9);
+    EXPECT_LE(angle, std::atan2(heading1.y, heading1.x) + 1e-9);
+  }
+}
+
+
+TEST(TrajectoryIndex, Slerp)
+{
+  ohm::TrajectoryIndex trajectory;
+  trajectory.add(0.0, glm::dvec3(0.0), glm::angleAxis(0.0, glm::dvec3(0, 0, 1)));
+  trajectory.add(1.0, glm::dvec3(0.0), glm::angleAxis(0.5 * M_PI, glm::dvec3(0, 0, 1)));
+
+  glm::dvec3 position;
+  glm::dquat rotation;
+  ASSERT_TRUE(trajectory.pose(0.5, position, rotation));
+  const glm::dvec3 heading = rotation * glm::dvec3(1, 0, 0);
+  EXPECT_NEAR(heading.x, std::cos(0.25 * M_PI), 1e-9);
+  EXPECT_NEAR(heading.y, std::sin(0.25 * M_PI), 1e-9);
+}
+}  // namespace trajectoryindextests
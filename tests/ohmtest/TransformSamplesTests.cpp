@@ -0,0 +1,180 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+#include <ohm/TransformSamplesCpu.h>
+
+#include <ohmtestcommon/OhmTestUtil.h>
+
+#include <gtest/gtest.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace transformsamplestests
+{
+TEST(TransformSamples, Cpu)
+{
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  // Build a trajectory which translates and rotates.
+  std::vector<double> traj_times;
+  std::vector<glm::dvec3> traj_positions;
+  std::vector<glm::dquat> traj_rotations;
+  for (int i = 0; i < 10; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    traj_times.emplace_back(100.0 + 0.1 * i);  // NOLINT(readability-magic-numbers)
+    traj_positions.emplace_back(glm::dvec3(0.5 * i, std::sin(i), -0.1 * i));  // NOLINT(readability-magic-numbers)
+    traj_rotations.emplace_back(glm::angleAxis(0.4 * i, glm::normalize(glm::dvec3(0.1 * i, 0.5, 1.0))));  // NOLINT
+  }
+
+  // Use enough samples for several chunks, with times spanning beyond the trajectory.
+  const size_t sample_count = 20000;
+  const double max_range = 8.0;
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-7.0, 7.0);
+  std::vector<double> sample_times;
+  std::vector<glm::dvec3> samples;
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    sample_times.emplace_back(99.95 + 1.0 * double(i) / double(sample_count));  // NOLINT(readability-magic-numbers)
+    samples.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+  // Add invalid samples.
+  samples[5] = glm::dvec3(std::numeric_limits<double>::quiet_NaN(), 0, 0);
+  samples[7000] = glm::dvec3(0, std::numeric_limits<double>::infinity(), 0);  // NOLINT(readability-magic-numbers)
+
+  // Calculate the expected results.
+  std::vector<glm::dvec3> expected_rays;
+  std::vector<double> expected_times;
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    const glm::dvec3 &sample = samples[i];
+    if (glm::any(glm::isnan(sample)) || glm::any(glm::isinf(sample)) || glm::length(sample) > max_range)
+    {
+      continue;
+    }
+    const double time = std::max(traj_times.front(), std::min(sample_times[i], traj_times.back()));
+    const size_t segment = std::min<size_t>(
+      std::upper_bound(traj_times.begin(), traj_times.end(), time) - traj_times.begin() - 1, traj_times.size() - 2);
+    const double t = (time - traj_times[segment]) / (traj_times[segment + 1] - traj_times[segment]);
+    const glm::dvec3 position = glm::mix(traj_positions[segment], traj_positions[segment + 1], t);
+    const glm::dquat rotation = glm::slerp(traj_rotations[segment], traj_rotations[segment + 1], t);
+    expected_rays.emplace_back(position);
+    expected_rays.emplace_back(position + rotation * sample);
+    expected_times.emplace_back(sample_times[i]);
+  }
+  ASSERT_LT(expected_times.size(), sample_count - 2);
+
+  for (bool use_threads : { false, true })
+  {
+    ohm::TransformSamplesCpu transformer;
+    transformer.setUseThreads(use_threads);
+    std::vector<glm::dvec3> rays;
+    std::vector<double> ray_times;
+    const size_t valid_count = transformer.transform(traj_times.data(), traj_positions.data(), traj_rotations.data(),
+                                                     unsigned(traj_times.size()), sample_times.data(), samples.data(),
+                                                     samples.size(), rays, max_range, &ray_times);
+    ASSERT_EQ(valid_count, expected_times.size());
+    ASSERT_EQ(rays.size(), expected_rays.size());
+    ASSERT_EQ(ray_times, expected_times);
+    for (size_t i = 0; i < rays.size(); ++i)
+    {
+      ASSERT_NEAR(glm::length(rays[i] - expected_rays[i]), 0.0, 1e-9) << i;
+    }
+  }
+
+  // A single transform applies to all samples.
+  ohm::TransformSamplesCpu transformer;
+  std::vector<glm::dvec3> rays;
+  ASSERT_EQ(transformer.transform(traj_times.data(), traj_positions.data(), traj_rotations.data(), 1u,
+                                  sample_times.data(), samples.data() + 10, 1u, rays),  // NOLINT
+            1u);
+  EXPECT_NEAR(glm::length(rays[0] - traj_positions[0]), 0.0, 1e-12);
+  EXPECT_NEAR(glm::length(rays[1] - (traj_positions[0] + traj_rotations[0] * samples[10])), 0.0, 1e-12);
+}
+
+
+TEST(TransformSamples, IntegrateLocalSamples)
+{
+  // Integrating structure of arrays sensor samples must match integrating the equivalent pre-transformed rays.
+  const std::vector<double> traj_times = { 10.0, 10.5, 11.0 };
+  const std::vector<glm::dvec3> traj_positions = { glm::dvec3(0, 0, 0), glm::dvec3(1, 0.5, 0), glm::dvec3(2, 0, 0.2) };
+  const std::vector<glm::dquat> traj_rotations = { glm::dquat(1, 0, 0, 0),
+                                                   glm::angleAxis(0.5, glm::dvec3(0, 0, 1)),  // NOLINT
+                                                   glm::angleAxis(1.0, glm::dvec3(0, 0, 1)) };  // NOLINT
+  ohm::SensorTrajectory trajectory;
+  trajectory.times = traj_times.data();
+  trajectory.translations = traj_positions.data();
+  trajectory.rotations = traj_rotations.data();
+  trajectory.count = unsigned(traj_times.size());
+
+  // Use more samples than a single integration batch.
+  const size_t sample_count = 70000;
+  const double max_range = 4.0;
+  std::mt19937 rand_engine(0x4321);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<float> rand(-3.0f, 3.0f);
+  std::vector<float> x(sample_count);
+  std::vector<float> y(sample_count);
+  std::vector<float> z(sample_count);
+  std::vector<float> intensities(sample_count);
+  std::vector<double> sample_times(sample_count);
+  std::vector<glm::dvec3> local_samples(sample_count);
+  for (size_t i = 0; i < sample_count; ++i)
+  {
+    x[i] = rand(rand_engine);
+    y[i] = rand(rand_engine);
+    z[i] = rand(rand_engine);
+    intensities[i] = float(i % 100);  // NOLINT(readability-magic-numbers)
+    sample_times[i] = 10.0 + double(i) / double(sample_count);
+    local_samples[i] = glm::dvec3(x[i], y[i], z[i]);
+  }
+
+  ohm::LocalSamples samples;
+  samples.x = x.data();
+  samples.y = y.data();
+  samples.z = z.data();
+  samples.timestamps = sample_times.data();
+  samples.intensities = intensities.data();
+  samples.count = sample_count;
+
+  // Reference map from pre-transformed rays.
+  ohm::TransformSamplesCpu transformer;
+  std::vector<glm::dvec3> rays;
+  std::vector<double> ray_times;
+  std::vector<float> ray_intensities;
+  const size_t ray_count =
+    transformer.transform(trajectory, samples, 0, sample_count, rays, max_range, &ray_times, &ray_intensities);
+  ASSERT_GT(ray_count, 0u);
+  ASSERT_LT(ray_count, sample_count);
+  ASSERT_EQ(ray_intensities.size(), ray_count);
+
+  // The double precision overload must give the same rays.
+  std::vector<glm::dvec3> vector_rays;
+  transformer.transform(traj_times.data(), traj_positions.data(), traj_rotations.data(), trajectory.count,
+                        sample_times.data(), local_samples.data(), sample_count, vector_rays, max_range);
+  ASSERT_EQ(vector_rays, rays);
+
+  const double resolution = 0.1;
+  ohm::OccupancyMap reference_map(resolution);
+  ohm::RayMapperOccupancy reference_mapper(&reference_map);
+  reference_mapper.integrateRays(rays.data(), rays.size(), ray_intensities.data(), ray_times.data(), ohm::kRfDefault);
+
+  ohm::OccupancyMap map(resolution);
+  ohm::RayMapperOccupancy mapper(&map);
+  EXPECT_EQ(mapper.integrateLocalSamples(samples, trajectory, ohm::kRfDefault, max_range), ray_count);
+
+  // Chunk stamps differ with batched integration, so skip the fine chunk comparison.
+  ohmtestutil::compareMaps(map, reference_map, ohmtestutil::kCfCompareExtended);
+}
+}  // namespace transformsamplestests
@@ -13,6 +13,9 @@
 #include <ohm/RayMapperTsdf.h>
 #include <ohm/VoxelData.h>
 
+#include <random>
+#include <vector>
+
 namespace tsdf
 {
 TEST(Tsdf, Basic)
@@ -135,4 +138,64 @@ TEST(Tsdf, Truncation)
     }
   }
 }
+
+TEST(Tsdf, Threaded)
+{
+  // Integrate the same random rays with and without threads. The threaded update must exactly match the serial one.
+  const double resolution = 0.1;
+  const glm::u8vec3 region_size(16);
+  const unsigned ray_count = 5000u;
+
+  std::mt19937 rng(4321u);
+  std::uniform_real_distribution<double> rand(-4.0, 4.0);
+  std::vector<glm::dvec3> rays;
+  rays.reserve(ray_count * 2);
+  for (unsigned i = 0; i < ray_count; ++i)
+  {
+    // Use a few sensor positions so many rays overlap.
+    rays.emplace_back(glm::dvec3(0.5 * double(i % 3)));
+    rays.emplace_back(glm::dvec3(rand(rng), rand(rng), rand(rng)));
+  }
+
+  ohm::TsdfOptions options;
+  options.default_truncation_distance = 0.3f;
+  options.max_weight = 50.0f;
+  options.sparsity_compensation_factor = 2.0f;
+
+  ohm::OccupancyMap serial_map(resolution, region_size, ohm::MapFlag::kTsdf);
+  ohm::RayMapperTsdf serial_mapper(&serial_map);
+  serial_mapper.setTsdfOptions(options);
+  serial_mapper.integrateRays(rays.data(), rays.size(), nullptr, nullptr, 0);
+
+  ohm::OccupancyMap threaded_map(resolution, region_size, ohm::MapFlag::kTsdf);
+  ohm::RayMapperTsdf threaded_mapper(&threaded_map);
+  threaded_mapper.setTsdfOptions(options);
+  threaded_mapper.setUseThreads(true);
+  threaded_mapper.integrateRays(rays.data(), rays.size(), nullptr, nullptr, 0);
+
+  ASSERT_EQ(serial_map.regionCount(), threaded_map.regionCount());
+
+  ohm::Voxel<const ohm::VoxelTsdf> serial_tsdf(
+    &serial_map, serial_map.layout().layerIndex(ohm::default_layer::tsdfLayerName()));
+  ohm::Voxel<const ohm::VoxelTsdf> threaded_tsdf(
+    &threaded_map, threaded_map.layout().layerIndex(ohm::default_layer::tsdfLayerName()));
+  ASSERT_TRUE(serial_tsdf.isLayerValid());
+  ASSERT_TRUE(threaded_tsdf.isLayerValid());
+
+  size_t compared = 0;
+  for (auto iter = serial_map.begin(); iter != serial_map.end(); ++iter)
+  {
+    serial_tsdf.setKey(*iter);
+    threaded_tsdf.setKey(*iter);
+    ASSERT_TRUE(serial_tsdf.isValid());
+    ASSERT_TRUE(threaded_tsdf.isValid());
+    const ohm::VoxelTsdf serial_data = serial_tsdf.data();
+    const ohm::VoxelTsdf threaded_data = threaded_tsdf.data();
+    // Exact comparison: the voxel update order is the same.
+    EXPECT_EQ(serial_data.weight, threaded_data.weight) << iter.key();
+    EXPECT_EQ(serial_data.distance, threaded_data.distance) << iter.key();
+    ++compared;
+  }
+  EXPECT_GT(compared, 0u);
+}
 }  // namespace tsdf
@@ -0,0 +1,99 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmtools/OhmVdb.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+namespace vdbtests
+{
+TEST(Vdb, OccupancyRoundTrip)
+{
+  // Use odd region dimensions to exercise regions which do not align with the VDB leaf nodes.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(15, 16, 17));
+  map.setOrigin(glm::dvec3(0.03, -0.02, 0.01));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 3.0, 1000u, 0x1234u);
+
+  openvdb::FloatGrid::Ptr grid = ohmtools::exportVdbGrid(map, ohmtools::VdbLayer::kOccupancy);
+  ASSERT_NE(grid, nullptr);
+
+  // Validate the export.
+  ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
+  openvdb::FloatGrid::ConstAccessor accessor = grid->getConstAccessor();
+  size_t observed_count = 0;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(*iter);
+    const glm::dvec3 centre = map.voxelCentreGlobal(*iter);
+    const openvdb::Coord ijk =
+      grid->transform().worldToIndexCellCentered(openvdb::Vec3d(centre.x, centre.y, centre.z));
+    float value = 0;
+    const bool active = accessor.probeValue(ijk, value);
+    if (occupancy.data() == ohm::unobservedOccupancyValue())
+    {
+      EXPECT_FALSE(active);
+      continue;
+    }
+    EXPECT_TRUE(active);
+    EXPECT_EQ(value, occupancy.data());
+    ++observed_count;
+  }
+  EXPECT_GT(observed_count, 0u);
+  EXPECT_EQ(grid->activeVoxelCount(), observed_count);
+
+  // Import into a new map and compare.
+  ohm::OccupancyMap imported(map.resolution(), map.regionVoxelDimensions());
+  imported.setOrigin(map.origin());
+  EXPECT_EQ(ohmtools::importVdbGrid(imported, *grid, ohmtools::VdbLayer::kOccupancy), observed_count);
+
+  ohm::Voxel<const float> imported_occupancy(&imported, imported.layout().occupancyLayer());
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(*iter);
+    if (occupancy.data() == ohm::unobservedOccupancyValue())
+    {
+      continue;
+    }
+    imported_occupancy.setKey(*iter);
+    ASSERT_TRUE(imported_occupancy.isValid());
+    EXPECT_EQ(imported_occupancy.data(), occupancy.data());
+  }
+
+  // A grid which does not align with the map voxels is rejected.
+  ohm::OccupancyMap misaligned(map.resolution() * 2.0, map.regionVoxelDimensions());
+  EXPECT_EQ(ohmtools::importVdbGrid(misaligned, *grid, ohmtools::VdbLayer::kOccupancy), 0u);
+}
+
+
+TEST(Vdb, Clearance)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  EXPECT_EQ(ohmtools::exportVdbGrid(map, ohmtools::VdbLayer::kClearance), nullptr);
+
+  ohm::OccupancyMap source(0.1, glm::u8vec3(16));
+  openvdb::FloatGrid::Ptr grid = openvdb::FloatGrid::create(-1.0f);
+  grid->setTransform(ohmtools::exportVdbGrid(source, ohmtools::VdbLayer::kOccupancy)->transform().copy());
+  grid->tree().setValueOn(openvdb::Coord(-3, 4, 20), 0.5f);
+  grid->tree().setValueOn(openvdb::Coord(10, -40, 2), 1.5f);
+
+  EXPECT_EQ(ohmtools::importVdbGrid(map, *grid, ohmtools::VdbLayer::kClearance), 2u);
+  ASSERT_GE(map.layout().clearanceLayer(), 0);
+
+  openvdb::FloatGrid::Ptr exported = ohmtools::exportVdbGrid(map, ohmtools::VdbLayer::kClearance);
+  ASSERT_NE(exported, nullptr);
+  EXPECT_EQ(exported->background(), -1.0f);
+  EXPECT_EQ(exported->activeVoxelCount(), 2u);
+  EXPECT_EQ(exported->tree().getValue(openvdb::Coord(-3, 4, 20)), 0.5f);
+  EXPECT_EQ(exported->tree().getValue(openvdb::Coord(10, -40, 2)), 1.5f);
+}
+}  // namespace vdbtests
@@ -0,0 +1,148 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapFlag.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/OccupancyType.h>
+#include <ohm/RaysQuery.h>
+#include <ohm/VisibilityQuery.h>
+#include <ohm/VoxelOccupancy.h>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace visibilityquerytests
+{
+void testVisibility(ohm::MapFlag map_flags)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, map_flags);
+
+  // Scatter occupied voxels.
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-4.0, 4.0);
+  for (unsigned i = 0; i < 20000u; ++i)
+  {
+    ohm::integrateHit(map, map.voxelKey(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine))));
+  }
+
+  std::vector<glm::dvec3> sources;
+  std::vector<glm::dvec3> targets;
+  for (unsigned i = 0; i < 20u; ++i)
+  {
+    sources.emplace_back(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+  }
+  for (unsigned i = 0; i < 70u; ++i)
+  {
+    targets.emplace_back(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+  }
+
+  // Validate against a RaysQuery, which includes the end point voxels.
+  ohm::VisibilityQuery query(map, ohm::VisibilityQuery::kQfIncludeEndPointVoxels);
+  query.setSources(sources);
+  query.setTargets(targets);
+  ASSERT_TRUE(query.execute());
+  ASSERT_EQ(query.numberOfResults(), sources.size() * targets.size());
+  ASSERT_EQ(query.rowWords(), 2u);
+
+  ohm::RaysQuery rays_query;
+  rays_query.setMap(&map);
+  for (const auto &source : sources)
+  {
+    for (const auto &target : targets)
+    {
+      rays_query.addRay(source, target);
+    }
+  }
+  ASSERT_TRUE(rays_query.execute());
+
+  size_t visible_count = 0;
+  for (size_t s = 0; s < sources.size(); ++s)
+  {
+    for (size_t t = 0; t < targets.size(); ++t)
+    {
+      const bool expect_visible =
+        rays_query.terminalOccupancyTypes()[s * targets.size() + t] != ohm::OccupancyType::kOccupied;
+      EXPECT_EQ(query.visible(s, t), expect_visible) << s << "," << t;
+      visible_count += query.visible(s, t) ? 1u : 0u;
+    }
+    // Unused bits are clear.
+    EXPECT_EQ(query.visibility()[s * query.rowWords() + 1] >> (targets.size() - 64u), 0u);
+  }
+  // Expect a mix of results.
+  EXPECT_GT(visible_count, 0u);
+  EXPECT_LT(visible_count, sources.size() * targets.size());
+
+  // Symmetric evaluation walks each pair once.
+  ohm::VisibilityQuery pairs(map);
+  pairs.setPoints(targets);
+  ohm::VisibilityQuery reference(map);
+  reference.setSources(targets);
+  reference.setTargets(targets);
+  ASSERT_TRUE(pairs.execute());
+  ASSERT_TRUE(reference.execute());
+  for (size_t s = 0; s < targets.size(); ++s)
+  {
+    EXPECT_TRUE(pairs.visible(s, s));
+    for (size_t t = s + 1; t < targets.size(); ++t)
+    {
+      EXPECT_EQ(pairs.visible(s, t), reference.visible(s, t)) << s << "," << t;
+      EXPECT_EQ(pairs.visible(t, s), pairs.visible(s, t)) << s << "," << t;
+    }
+  }
+}
+
+
+TEST(VisibilityQuery, Cpu)
+{
+  testVisibility(ohm::MapFlag::kNone);
+}
+
+
+TEST(VisibilityQuery, Summary)
+{
+  testVisibility(ohm::MapFlag::kOccupancySummary);
+}
+
+
+TEST(VisibilityQuery, Wall)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution);
+
+  // Build a wall one voxel thick on the x = 0 plane.
+  for (int y = -20; y < 20; ++y)
+  {
+    for (int z = -20; z < 20; ++z)
+    {
+      ohm::integrateHit(map, map.voxelKey(glm::dvec3(0.5, y + 0.5, z + 0.5) * resolution));
+    }
+  }
+
+  // Use voxel centres so the segments do not graze voxel boundaries. The last point lies in a wall voxel and is
+  // visible from either side when excluding the end point voxels.
+  const std::vector<glm::dvec3> points = { glm::dvec3(-1, 0.05, 0.05), glm::dvec3(-1, 1.05, 0.05),
+                                           glm::dvec3(1, 0.05, 0.05), glm::dvec3(0.05, 0.05, 0.05) };
+  ohm::VisibilityQuery query(map);
+  query.setPoints(points);
+  ASSERT_TRUE(query.execute());
+  EXPECT_TRUE(query.visible(0, 1));
+  EXPECT_FALSE(query.visible(0, 2));
+  EXPECT_FALSE(query.visible(1, 2));
+  EXPECT_TRUE(query.visible(0, 3));
+  EXPECT_TRUE(query.visible(2, 3));
+
+  // Unobserved space may be treated as occluding.
+  ohm::VisibilityQuery unknown(map, ohm::kQfUnknownAsOccupied);
+  unknown.setSources({ glm::dvec3(-1, 0.05, 0.05) });
+  unknown.setTargets({ glm::dvec3(-1, 0.05, 3.05) });
+  ASSERT_TRUE(unknown.execute());
+  EXPECT_FALSE(unknown.visible(0, 0));
+}
+}  // namespace visibilityquerytests
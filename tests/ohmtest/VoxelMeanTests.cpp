@@ -23,10 +23,12 @@
 
 #include <ohmutil/GlmStream.h>
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <random>
+#include <tuple>
 
 using namespace ohm;
 
@@ -262,4 +264,94 @@ TEST(VoxelMean, Cpu)
 
   printVoxelPositionResults(results, false, map.resolution());
 }
+TEST(VoxelMean, Batch)
+{
+  // Compare the batched, sorted mean update against the per sample update.
+  const double resolution = 0.5;
+  const glm::u8vec3 region_size(32);
+
+  OccupancyMap per_sample_map(resolution, region_size, MapFlag::kVoxelMean);
+  OccupancyMap batch_map(resolution, region_size, MapFlag::kVoxelMean);
+
+  std::mt19937 rand_engine(0x10u);
+  std::uniform_real_distribution<double> rand(-2.0, 2.0);
+
+  // Build a hit list, then sort by key so the samples for each voxel are contiguous.
+  std::vector<std::pair<Key, glm::dvec3>> hits;
+  for (unsigned i = 0; i < 4000u; ++i)
+  {
+    const glm::dvec3 sample(rand(rand_engine), rand(rand_engine), rand(rand_engine));
+    hits.emplace_back(batch_map.voxelKey(sample), sample);
+  }
+  std::sort(hits.begin(), hits.end(), [](const std::pair<Key, glm::dvec3> &a, const std::pair<Key, glm::dvec3> &b) {
+    return std::make_tuple(a.first.regionKey().x, a.first.regionKey().y, a.first.regionKey().z, a.first.localKey().x,
+                           a.first.localKey().y, a.first.localKey().z) <
+           std::make_tuple(b.first.regionKey().x, b.first.regionKey().y, b.first.regionKey().z, b.first.localKey().x,
+                           b.first.localKey().y, b.first.localKey().z);
+  });
+
+  std::vector<Key> keys;
+  std::vector<glm::dvec3> samples;
+  for (const auto &hit : hits)
+  {
+    keys.emplace_back(hit.first);
+    samples.emplace_back(hit.second);
+  }
+
+  Voxel<VoxelMean> per_sample_voxel(&per_sample_map, per_sample_map.layout().meanLayer());
+  for (const glm::dvec3 &sample : samples)
+  {
+    per_sample_voxel.setKey(per_sample_map.voxelKey(sample));
+    updatePositionSafe(per_sample_voxel, sample);
+  }
+  per_sample_voxel.reset();
+
+  const size_t updated_count = updatePositionsSorted(batch_map, keys.data(), samples.data(), keys.size());
+  EXPECT_GT(updated_count, 0u);
+  EXPECT_LT(updated_count, keys.size());
+
+  // Validate. Per sample quantisation error accumulates, so allow some error.
+  const double tolerance = resolution / 100.0;
+  Voxel<const VoxelMean> expect(&per_sample_map, per_sample_map.layout().meanLayer());
+  Voxel<const VoxelMean> actual(&batch_map, batch_map.layout().meanLayer());
+  size_t voxel_count = 0;
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    if (i > 0 && keys[i] == keys[i - 1])
+    {
+      continue;
+    }
+    expect.setKey(keys[i]);
+    actual.setKey(keys[i]);
+    ASSERT_TRUE(expect.isValid());
+    ASSERT_TRUE(actual.isValid());
+    EXPECT_EQ(expect.data().count, actual.data().count);
+    const glm::dvec3 expect_pos = positionUnsafe(expect);
+    const glm::dvec3 actual_pos = positionUnsafe(actual);
+    EXPECT_NEAR(expect_pos.x, actual_pos.x, tolerance);
+    EXPECT_NEAR(expect_pos.y, actual_pos.y, tolerance);
+    EXPECT_NEAR(expect_pos.z, actual_pos.z, tolerance);
+    ++voxel_count;
+  }
+  EXPECT_EQ(voxel_count, updated_count);
+
+  // The batch pack/unpack must match the scalar versions exactly.
+  std::vector<unsigned> patterns(samples.size());
+  std::vector<glm::dvec3> local_coords(samples.size());
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    local_coords[i] = samples[i] - batch_map.voxelCentreGlobal(keys[i]);
+  }
+  subVoxelCoordBatch(local_coords.data(), local_coords.size(), resolution, patterns.data());
+  subVoxelToLocalCoordBatch(patterns.data(), patterns.size(), resolution, local_coords.data());
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    const glm::dvec3 local = samples[i] - batch_map.voxelCentreGlobal(keys[i]);
+    ASSERT_EQ(patterns[i], subVoxelCoord(local, resolution));
+    const glm::dvec3 unpacked = subVoxelToLocalCoord<glm::dvec3>(patterns[i], resolution);
+    ASSERT_EQ(unpacked.x, local_coords[i].x);
+    ASSERT_EQ(unpacked.y, local_coords[i].y);
+    ASSERT_EQ(unpacked.z, local_coords[i].z);
+  }
+}
 }  // namespace voxelmean
@@ -0,0 +1,116 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/Voxel.h>
+#include <ohm/VoxelData.h>
+#include <ohm/VoxelSet.h>
+
+#include <gtest/gtest.h>
+
+namespace voxelsettests
+{
+TEST(VoxelSet, ReadWrite)
+{
+  ohm::OccupancyMap map(0.1, ohm::MapFlag::kVoxelMean);
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int mean_layer = map.layout().meanLayer();
+  const ohm::Key key(1, 2, 3, 4, 5, 6);
+
+  {
+    ohm::VoxelSet<float, ohm::VoxelMean> voxels(&map, { occupancy_layer, mean_layer });
+    ASSERT_TRUE(voxels.isLayerValid());
+    EXPECT_FALSE(voxels.isValid());
+
+    voxels.setKey(key);
+    ASSERT_TRUE(voxels.isValid());
+    voxels.write<0>(0.5f);
+    ohm::VoxelMean mean{ 42u, 7u };
+    voxels.write<1>(mean);
+    EXPECT_EQ(voxels.data<0>(), 0.5f);
+    EXPECT_EQ(voxels.data<1>().count, 7u);
+  }
+
+  // Validate against the single layer accessors.
+  ohm::Voxel<const float> occupancy(&map, occupancy_layer, key);
+  ohm::Voxel<const ohm::VoxelMean> mean(&map, mean_layer, key);
+  ASSERT_TRUE(occupancy.isValid());
+  ASSERT_TRUE(mean.isValid());
+  EXPECT_EQ(occupancy.data(), 0.5f);
+  EXPECT_EQ(mean.data().coord, 42u);
+  EXPECT_EQ(mean.data().count, 7u);
+
+  // The dirty stamp is shared by all modified layers.
+  const ohm::MapChunk *chunk = map.region(key.regionKey());
+  ASSERT_NE(chunk, nullptr);
+  const uint64_t dirty_stamp = chunk->dirty_stamp.load();
+  EXPECT_EQ(dirty_stamp, map.stamp());
+  EXPECT_EQ(chunk->touched_stamps[occupancy_layer].load(), dirty_stamp);
+  EXPECT_EQ(chunk->touched_stamps[mean_layer].load(), dirty_stamp);
+  EXPECT_EQ(chunk->first_valid_index, ohm::voxelIndex(key, map.regionVoxelDimensions()));
+}
+
+
+TEST(VoxelSet, Const)
+{
+  ohm::OccupancyMap map(0.1, ohm::MapFlag::kVoxelMean);
+  const ohm::OccupancyMap &const_map = map;
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int mean_layer = map.layout().meanLayer();
+
+  ohm::VoxelSet<const float, const ohm::VoxelMean> voxels(&const_map, { occupancy_layer, mean_layer });
+  ASSERT_TRUE(voxels.isLayerValid());
+
+  // A read only set must not create regions.
+  voxels.setKey(ohm::Key(0, 0, 0, 1, 1, 1));
+  EXPECT_FALSE(voxels.isValid());
+  EXPECT_EQ(map.regionCount(), 0u);
+
+  // Mismatched types invalidate the set.
+  ohm::VoxelSet<const float, const float> bad_voxels(&const_map, { occupancy_layer, mean_layer });
+  EXPECT_FALSE(bad_voxels.isLayerValid());
+  EXPECT_NE(bad_voxels.errorFlags() & unsigned(decltype(bad_voxels)::Error::kVoxelSizeMismatch), 0u);
+}
+
+
+TEST(VoxelSet, Iterate)
+{
+  ohm::OccupancyMap map(0.1, ohm::MapFlag::kVoxelMean);
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const int mean_layer = map.layout().meanLayer();
+
+  // Populate voxels spanning several regions.
+  {
+    ohm::VoxelSet<float, ohm::VoxelMean> voxels(&map, { occupancy_layer, mean_layer });
+    for (int i = 0; i < 100; ++i)
+    {
+      const ohm::Key key = map.voxelKey(glm::dvec3(0.25 * i, 0.0, 0.0));
+      voxels.setKey(key);
+      voxels.write<0>(float(i));
+      voxels.write<1>(ohm::VoxelMean{ 0u, unsigned(i) });
+    }
+  }
+
+  // Occupancy and mean values must agree for every voxel.
+  ohm::VoxelSet<const float, const ohm::VoxelMean> voxels(&map, { occupancy_layer, mean_layer });
+  unsigned populated = 0;
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    const ohm::OccupancyMap::const_iterator const_iter = iter;
+    voxels.setKey(const_iter);
+    ASSERT_TRUE(voxels.isValid());
+    const float value = voxels.data<0>();
+    if (value != ohm::unobservedOccupancyValue())
+    {
+      EXPECT_EQ(unsigned(value), voxels.data<1>().count);
+      ++populated;
+    }
+  }
+  EXPECT_EQ(populated, 100u);
+}
+}  // namespace voxelsettests
@@ -0,0 +1,114 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "OhmTestConfig.h"
+
+#include <ohm/MapChunk.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/ParallelForEach.h>
+#include <ohm/VoxelData.h>
+#include <ohm/VoxelSpan.h>
+
+#include <gtest/gtest.h>
+
+#include "ohmtestcommon/OhmTestUtil.h"
+
+#include <algorithm>
+
+namespace voxelspantests
+{
+TEST(VoxelSpan, Read)
+{
+  // Validate span contents and key decoding against Voxel access.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+  ASSERT_GT(map.regionCount(), 1u);
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  ohm::WorkerLocal<size_t> worker_count(0u);
+  ohm::forEachVoxelSpan<float>(map, occupancy_layer,
+                               [&](const ohm::VoxelSpan<const float> &span, unsigned worker_index)  //
+                               {
+                                 ohm::Voxel<const float> voxel(&map, occupancy_layer);
+                                 ASSERT_EQ(span.size(), 8u * 8u * 8u);
+                                 for (size_t i = 0; i < span.size(); ++i)
+                                 {
+                                   const ohm::Key key = span.keyDecoder().key(i);
+                                   EXPECT_EQ(span.keyDecoder().index(key.localKey()), i);
+                                   voxel.setKey(key, span.chunk());
+                                   ASSERT_TRUE(voxel.isValid());
+                                   EXPECT_EQ(span[i], voxel.data());
+                                   worker_count.local(worker_index) += ohm::isOccupied(voxel) ? 1 : 0;
+                                 }
+                               });
+
+  size_t iter_occupied_count = 0;
+  ohm::Voxel<const float> occupancy(&map, occupancy_layer);
+  for (auto iter = map.begin(); iter != map.end(); ++iter)
+  {
+    occupancy.setKey(iter);
+    iter_occupied_count += ohm::isOccupied(occupancy) ? 1 : 0;
+  }
+  occupancy.reset();
+
+  EXPECT_GT(iter_occupied_count, 0u);
+  EXPECT_EQ(worker_count.combine([](size_t a, size_t b) { return a + b; }), iter_occupied_count);
+
+  // Mismatched types yield invalid spans.
+  const ohm::MapChunk *chunk = map.region(map.voxelKey(glm::dvec3(0.0)).regionKey());
+  ASSERT_NE(chunk, nullptr);
+  EXPECT_FALSE(ohm::VoxelSpan<const double>(chunk, map, occupancy_layer).isValid());
+  EXPECT_TRUE(ohm::VoxelSpan<const float>(chunk, map, occupancy_layer).isValid());
+}
+
+
+TEST(VoxelSpan, Transform)
+{
+  // Threshold the occupancy layer with a map wide transform and compare against the same operation via Voxel.
+  ohm::OccupancyMap map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+  ohm::OccupancyMap reference_map(0.25, glm::u8vec3(8));
+  ohmtestutil::integrateRandomRays(reference_map, glm::dvec3(0.0), 5.0, 1000u, 0x1234u);
+
+  const float limit = 0.5f * map.maxVoxelValue();
+  const int occupancy_layer = map.layout().occupancyLayer();
+  const uint64_t stamp_before = map.stamp();
+  ohm::transformVoxelSpans<float>(map, occupancy_layer,
+                                  [limit](const ohm::VoxelSpan<float> &span, unsigned /*worker_index*/)  //
+                                  {
+                                    for (float &value : span)
+                                    {
+                                      // Unobserved voxels are infinite and must remain so.
+                                      if (!ohm::isUnobserved(value))
+                                      {
+                                        value = std::min(value, limit);
+                                      }
+                                    }
+                                  });
+  EXPECT_GT(map.stamp(), stamp_before);
+
+  ohm::Voxel<float> reference(&reference_map, reference_map.layout().occupancyLayer());
+  for (auto iter = reference_map.begin(); iter != reference_map.end(); ++iter)
+  {
+    reference.setKey(iter);
+    if (!ohm::isUnobserved(reference))
+    {
+      reference.write(std::min(reference.data(), limit));
+    }
+  }
+  reference.reset();
+
+  ohm::Voxel<const float> occupancy(&map, occupancy_layer);
+  ohm::Voxel<const float> expected(&reference_map, reference_map.layout().occupancyLayer());
+  for (auto iter = reference_map.begin(); iter != reference_map.end(); ++iter)
+  {
+    expected.setKey(iter);
+    occupancy.setKey(*iter);
+    ASSERT_TRUE(occupancy.isValid());
+    EXPECT_EQ(occupancy.data(), expected.data());
+    EXPECT_EQ(occupancy.chunk()->touched_stamps[occupancy_layer].load(), occupancy.chunk()->dirty_stamp.load());
+  }
+}
+}  // namespace voxelspantests
@@ -10,10 +10,20 @@
 #include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
 #include <ohm/OccupancyMap.h>
+#include <ohm/OhmConfig.h>
+#include <ohm/RayMapperOccupancy.h>
 #include <ohm/VoxelData.h>
+#include <ohm/VoxelOccupancy.h>
 
 #include <gtest/gtest.h>
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/global_control.h>
+#endif  // OHM_FEATURE_THREADS
+
+#include <random>
+#include <vector>
+
 #include <stdio.h> /* defines FILENAME_MAX */
 #ifdef WIN32
 #include <direct.h>
@@ -258,4 +268,79 @@ void compareMaps(const OccupancyMap &map, const OccupancyMap &reference_map, con
     }
   }
 }
+
+
+void buildObstacleMap(OccupancyMap &map, std::vector<Key> &obstacles, double obstacle_chance, unsigned seed)
+{
+  std::mt19937 rand_engine(seed);
+  std::uniform_real_distribution<double> rand(0.0, 1.0);
+  const int voxel_extents = 12;
+
+  for (int z = -voxel_extents; z < voxel_extents; ++z)
+  {
+    for (int y = -voxel_extents; y < voxel_extents; ++y)
+    {
+      for (int x = -voxel_extents; x < voxel_extents; ++x)
+      {
+        const Key key = map.voxelKey(glm::dvec3(x + 0.5, y + 0.5, z + 0.5) * map.resolution());
+        if (rand(rand_engine) < obstacle_chance)
+        {
+          integrateHit(map, key);
+          obstacles.emplace_back(key);
+        }
+        else
+        {
+          integrateMiss(map, key);
+        }
+      }
+    }
+  }
+}
+
+
+std::vector<glm::dvec3> randomRays(const glm::dvec3 &origin, double extent, size_t ray_count, unsigned seed)
+{
+  std::mt19937 rand_engine(seed);
+  std::uniform_real_distribution<double> rand(-extent, extent);
+  std::vector<glm::dvec3> rays;
+  rays.reserve(2 * ray_count);
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    rays.emplace_back(origin);
+    rays.emplace_back(origin + glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+  return rays;
+}
+
+
+void integrateRandomRays(OccupancyMap &map, const glm::dvec3 &origin, double extent, size_t ray_count, unsigned seed,
+                         bool use_threads)
+{
+  const std::vector<glm::dvec3> rays = randomRays(origin, extent, ray_count, seed);
+  RayMapperOccupancy mapper(&map);
+  mapper.setUseThreads(use_threads);
+  mapper.integrateRays(rays.data(), rays.size());
+}
+
+
+struct WorkerThreadScope::Detail
+{
+#ifdef OHM_FEATURE_THREADS
+  tbb::global_control parallelism;
+
+  explicit Detail(unsigned thread_count)
+    : parallelism(tbb::global_control::max_allowed_parallelism, thread_count)
+  {}
+#else   // OHM_FEATURE_THREADS
+  explicit Detail(unsigned /*thread_count*/) {}
+#endif  // OHM_FEATURE_THREADS
+};
+
+
+WorkerThreadScope::WorkerThreadScope(unsigned thread_count)
+  : imp_(std::make_unique<Detail>(thread_count))
+{}
+
+
+WorkerThreadScope::~WorkerThreadScope() = default;
 }  // namespace ohmtestutil
@@ -8,8 +8,13 @@
 
 #include <glm/fwd.hpp>
 
+#include <cstddef>
+#include <memory>
+#include <vector>
+
 namespace ohm
 {
+class Key;
 class OccupancyMap;
 }
 
@@ -42,6 +47,55 @@ void compareMaps(const ohm::OccupancyMap &map, const ohm::OccupancyMap &referenc
 void compareMaps(const ohm::OccupancyMap &map, const ohm::OccupancyMap &reference_map, const glm::dvec3 &min_ext,
                  const glm::dvec3 &max_ext, unsigned compare_flags = kCfDefault,
                  unsigned allowed_occupancy_mismatch_count = 0);
+
+/// Populate @p map with a block of observed voxels around the origin, 24 voxels to a side. Each voxel is randomly
+/// marked as an obstacle (occupied) with probability @p obstacle_chance , otherwise it is marked free.
+/// @param map The map to populate.
+/// @param[out] obstacles The keys of the obstacle voxels are appended here.
+/// @param obstacle_chance The probability of each voxel being an obstacle [0, 1].
+/// @param seed Random number generator seed for the obstacle selection.
+void buildObstacleMap(ohm::OccupancyMap &map, std::vector<ohm::Key> &obstacles, double obstacle_chance,
+                      unsigned seed = 42);
+
+/// Generate @p ray_count random rays as origin/end point pairs. Each ray starts at @p origin and ends at a random
+/// offset from @p origin , uniformly distributed in [-extent, extent] on each axis.
+/// @param origin The origin of every ray.
+/// @param extent Bounds the random ray end point offsets from @p origin on each axis.
+/// @param ray_count The number of rays to generate.
+/// @param seed Random number generator seed for the ray end points.
+/// @return The rays: 2 * @p ray_count points.
+std::vector<glm::dvec3> randomRays(const glm::dvec3 &origin, double extent, size_t ray_count, unsigned seed);
+
+/// Integrate @p ray_count rays into @p map using a @c RayMapperOccupancy . Each ray starts at @p origin and ends at a
+/// random offset from @p origin , uniformly distributed in [-extent, extent] on each axis. See @c randomRays() .
+/// @param map The map to integrate into.
+/// @param origin The origin of every ray.
+/// @param extent Bounds the random ray end point offsets from @p origin on each axis.
+/// @param ray_count The number of rays to integrate.
+/// @param seed Random number generator seed for the ray end points.
+/// @param use_threads Enable threaded ray integration; see @c RayMapperOccupancy::setUseThreads() .
+void integrateRandomRays(ohm::OccupancyMap &map, const glm::dvec3 &origin, double extent, size_t ray_count,
+                         unsigned seed, bool use_threads = false);
+
+/// Raises the thread parallelism limit to @p thread_count for the lifetime of the object. This ensures threaded code
+/// paths run with multiple worker threads regardless of the host concurrency. Has no effect without
+/// @c OHM_FEATURE_THREADS .
+class WorkerThreadScope
+{
+public:
+  /// Constructor.
+  /// @param thread_count The number of worker threads to allow.
+  explicit WorkerThreadScope(unsigned thread_count = 4);
+  /// Destructor, restoring the previous thread limit.
+  ~WorkerThreadScope();
+
+  WorkerThreadScope(const WorkerThreadScope &) = delete;
+  WorkerThreadScope &operator=(const WorkerThreadScope &) = delete;
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> imp_;
+};
 }  // namespace ohmtestutil
 
 #endif  // OHMTESTUTIL_H
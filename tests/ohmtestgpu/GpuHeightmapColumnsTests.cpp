@@ -0,0 +1,83 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohmgpu/HeightmapColumnsGpu.h>
+#include <ohmgpu/OhmGpu.h>
+
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <ohmutil/GlmStream.h>
+
+#include <gtest/gtest.h>
+
+namespace heightmapcolumnstests
+{
+TEST(HeightmapColumns, Planar)
+{
+  const double resolution = 0.1;
+  const glm::u8vec3 region_size(16);
+  ohm::OccupancyMap map(resolution, region_size);
+
+  // Build a ground plane just below z = 0 with a step over half the region. Observe free space above both.
+  const double ground_height = -0.5 * resolution;
+  const double step_height = 2.5 * resolution;
+  for (int y = 0; y < region_size.y; ++y)
+  {
+    for (int x = 0; x < region_size.x; ++x)
+    {
+      const glm::dvec3 column_pos((x + 0.5) * resolution, (y + 0.5) * resolution, 0);
+      const double surface_height = (x < region_size.x / 2) ? step_height : ground_height;
+      ohm::integrateHit(map, map.voxelKey(glm::dvec3(column_pos.x, column_pos.y, surface_height)));
+      for (int z = 1; z < 10; ++z)  // NOLINT(readability-magic-numbers)
+      {
+        ohm::integrateMiss(map,
+                           map.voxelKey(glm::dvec3(column_pos.x, column_pos.y, surface_height + z * resolution)));
+      }
+    }
+  }
+
+  ohm::HeightmapColumnsGpu query(ohm::gpuDevice());
+  query.setFloor(1.0);
+  query.setCeiling(1.0);
+  query.setMinClearance(0.5);  // NOLINT(readability-magic-numbers)
+  ASSERT_TRUE(query.calculateForRegion(map, glm::i16vec3(0), 0.5));  // NOLINT(readability-magic-numbers)
+
+  ASSERT_EQ(query.results().size(), size_t(region_size.x) * size_t(region_size.y));
+  for (int y = 0; y < region_size.y; ++y)
+  {
+    for (int x = 0; x < region_size.x; ++x)
+    {
+      const auto &candidate = query.results()[y * region_size.x + x];
+      const glm::dvec3 column_pos((x + 0.5) * resolution, (y + 0.5) * resolution, 0);
+      const double surface_height = (x < region_size.x / 2) ? step_height : ground_height;
+      EXPECT_EQ(candidate.type, ohm::HeightmapColumnsGpu::kSurface) << x << "," << y;
+      EXPECT_EQ(candidate.key, map.voxelKey(glm::dvec3(column_pos.x, column_pos.y, surface_height)))
+        << x << "," << y;
+      EXPECT_GE(candidate.clearance, query.minClearance()) << x << "," << y;
+      EXPECT_TRUE(candidate.observed_above) << x << "," << y;
+    }
+  }
+
+  // Layered results find the same surfaces first with no further layers below.
+  query.setMaxLayers(2);
+  ASSERT_TRUE(query.calculateForRegion(map, glm::i16vec3(0), 0.5));  // NOLINT(readability-magic-numbers)
+  ASSERT_EQ(query.results().size(), 2u * size_t(region_size.x) * size_t(region_size.y));
+  for (int y = 0; y < region_size.y; ++y)
+  {
+    for (int x = 0; x < region_size.x; ++x)
+    {
+      const auto *candidates = &query.results()[2 * (y * region_size.x + x)];
+      const glm::dvec3 column_pos((x + 0.5) * resolution, (y + 0.5) * resolution, 0);
+      const double surface_height = (x < region_size.x / 2) ? step_height : ground_height;
+      EXPECT_EQ(candidates[0].type, ohm::HeightmapColumnsGpu::kSurface) << x << "," << y;
+      EXPECT_EQ(candidates[0].key, map.voxelKey(glm::dvec3(column_pos.x, column_pos.y, surface_height)))
+        << x << "," << y;
+      // Nothing is recorded below the ground.
+      EXPECT_EQ(candidates[1].type, ohm::HeightmapColumnsGpu::kNone) << x << "," << y;
+    }
+  }
+}
+}  // namespace heightmapcolumnstests
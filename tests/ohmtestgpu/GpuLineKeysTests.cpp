@@ -17,7 +17,9 @@
 #include <ohmtools/OhmGen.h>
 #include <ohmutil/GlmStream.h>
 
+#include <atomic>
 #include <chrono>
+#include <future>
 #include <random>
 
 #include <gtest/gtest.h>
@@ -278,4 +280,47 @@ TEST(LineKeys, QueryGpu)
     compareResults(gpu_query, gpu_query2);
   }
 }
+
+
+TEST(LineKeys, QueryGpuAsync)
+{
+  // The completion function of an asynchronous GPU query fires once the GPU completes, without a wait() call.
+  const double query_half_extents = 10.0;
+  const int query_count = 1000;
+  ohm::OccupancyMap map(0.25);
+
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-query_half_extents, query_half_extents);
+  std::vector<glm::dvec3> line_points;
+  for (int i = 0; i < query_count; ++i)
+  {
+    line_points.push_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+    line_points.push_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  ohm::LineKeysQuery cpu_query;
+  cpu_query.setMap(&map);
+  cpu_query.setRays(line_points.data(), line_points.size());
+  ASSERT_TRUE(cpu_query.execute());
+
+  ohm::LineKeysQueryGpu gpu_query(ohm::kQfGpuEvaluate | ohm::kQfNoCache);
+  gpu_query.setMap(&map);
+  gpu_query.setRays(line_points.data(), line_points.size());
+
+  std::promise<bool> completed;
+  std::future<bool> completed_future = completed.get_future();
+  std::atomic_int callback_count{ 0 };
+  ASSERT_TRUE(gpu_query.executeAsync([&](ohm::Query &query, bool ok) {
+    EXPECT_EQ(&query, &gpu_query);
+    ++callback_count;
+    completed.set_value(ok);
+  }));
+
+  // Only wait() once the completion function has fired.
+  ASSERT_EQ(completed_future.wait_for(std::chrono::seconds(30)), std::future_status::ready);
+  EXPECT_TRUE(completed_future.get());
+  EXPECT_TRUE(gpu_query.wait());
+  EXPECT_EQ(callback_count, 1);
+  compareResults(gpu_query, cpu_query);
+}
 }  // namespace linekeys
@@ -15,18 +15,34 @@
 #include <ohm/OccupancyUtil.h>
 #include <ohm/RayMapperNdt.h>
 #include <ohm/RayMapperOccupancy.h>
+#include <ohm/VoxelBlock.h>
+#include <ohm/VoxelBuffer.h>
 #include <ohm/VoxelData.h>
+#include <ohm/VoxelOccupancy.h>
 #include <ohmgpu/GpuCache.h>
+#include <ohmgpu/GpuCacheStats.h>
+#include <ohmgpu/GpuLayerCache.h>
 #include <ohmgpu/GpuMap.h>
+#include <ohmgpu/GpuMapSnapshot.h>
+#include <ohmgpu/GpuHybridMap.h>
+#include <ohmgpu/GpuMultiMap.h>
 #include <ohmgpu/GpuNdtMap.h>
+#include <ohmgpu/OhmGpu.h>
+#include <ohmgpu/gpu/RegionTable.h>
+
+#include <gputil/gpuDevice.h>
+#include <gputil/gpuProfiler.h>
 
 #include <logutil/LogUtil.h>
 #include <ohmtools/OhmCloud.h>
 
+#include <glm/ext.hpp>
+
 #include <chrono>
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <thread>
 
@@ -60,6 +76,12 @@ struct GpuMapTestParams
   double ray_segment_length = 0;
   unsigned batch_size = 0u;
   size_t gpu_mem_size = 0u;
+  unsigned pipeline_depth = 0u;     ///< GpuMap::setPipelineDepth() when non zero.
+  unsigned stream_batch_size = 0u;  ///< GpuMap::setStreamBatchSize()
+  bool aggregate_updates = false;   ///< GpuMap::setAggregateUpdates()
+  bool coherent_rays = false;       ///< GpuMap::setCoherentRays()
+  bool gpu_region_walk = false;     ///< GpuMap::setGpuRegionWalk()
+  unsigned gpu_flags = 0u;          ///< gpumap::enableGpu() flags when non zero.
   glm::u8vec3 region_size = glm::u8vec3(32);
   bool voxel_means = false;
   bool ndt = false;
@@ -87,11 +109,27 @@ void gpuMapTest(GpuMapTestParams params, const std::vector<glm::dvec3> &rays, co
     cpu_ray_mapper = std::make_unique<RayMapperOccupancy>(&cpu_map);
   }
 
+  if (params.gpu_flags)
+  {
+    // Enable GPU before creating the GpuMap so our flags are used.
+    gpumap::enableGpu(gpu_map, (params.gpu_mem_size) ? params.gpu_mem_size : GpuCache::kDefaultTargetMemSize,
+                      params.gpu_flags);
+  }
+
   std::unique_ptr<GpuMap> gpu_wrap((!params.ndt) ?
                                      new GpuMap(&gpu_map, true, params.batch_size, params.gpu_mem_size) :
                                      new GpuNdtMap(&gpu_map, true, params.batch_size, params.gpu_mem_size));
 
   gpu_wrap->setRaySegmentLength(params.ray_segment_length);
+  if (params.pipeline_depth)
+  {
+    gpu_wrap->setPipelineDepth(params.pipeline_depth);
+    ASSERT_EQ(gpu_wrap->pipelineDepth(), std::min(params.pipeline_depth, GpuMap::maxPipelineDepth()));
+  }
+  gpu_wrap->setStreamBatchSize(params.stream_batch_size);
+  gpu_wrap->setAggregateUpdates(params.aggregate_updates);
+  gpu_wrap->setCoherentRays(params.coherent_rays);
+  gpu_wrap->setGpuRegionWalk(params.gpu_region_walk);
 
   ASSERT_TRUE(gpu_wrap->gpuOk());
 
@@ -373,6 +411,223 @@ TEST(GpuMap, PopulateLarge)
   gpuMapTest(params, rays, compareCpuGpuMaps, "large");
 }
 
+TEST(GpuMap, PopulatePipelined)
+{
+  const double map_extents = 25.0;
+  const unsigned ray_count = 1024 * 32;
+
+  GpuMapTestParams params;
+  params.batch_size = 1024u;
+  params.pipeline_depth = GpuMap::maxPipelineDepth();
+
+  // Make some rays.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpuMapTest(params, rays, compareCpuGpuMaps, "pipelined");
+}
+
+TEST(GpuMap, PopulateAggregated)
+{
+  const double map_extents = 25.0;
+  const unsigned ray_count = 1024 * 32;
+
+  GpuMapTestParams params;
+  params.batch_size = 4096u;
+  params.aggregate_updates = true;
+
+  // Make some rays. All rays share an origin so the voxels near the origin are heavily contended.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpuMapTest(params, rays, compareCpuGpuMaps, "aggregated");
+}
+
+TEST(GpuMap, PopulateCoherent)
+{
+  const double map_extents = 25.0;
+  const unsigned ray_count = 1024 * 32;
+
+  GpuMapTestParams params;
+  params.batch_size = 4096u;
+  params.ray_segment_length = 5.0;
+  params.coherent_rays = true;
+
+  // Make some rays from several origins so the rays are reordered by region and direction.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)) * 0.1);
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpuMapTest(params, rays, compareCpuGpuMaps, "coherent");
+}
+
+TEST(GpuMap, PopulateGpuRegionWalk)
+{
+  const double map_extents = 25.0;
+  const unsigned ray_count = 1024 * 32;
+
+  GpuMapTestParams params;
+  params.batch_size = 4096u;
+  params.gpu_region_walk = true;
+
+  // Long rays crossing many regions, so the region set overflows the initial output capacity.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)) * 0.1);
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpuMapTest(params, rays, compareCpuGpuMaps, "gpu-region-walk");
+}
+
+TEST(GpuMap, PopulateTransferQueue)
+{
+  // Pipeline batches with a small cache so region uploads and eviction downloads on the transfer queue overlap the
+  // region update kernels.
+  const double map_extents = 50.0;
+  const unsigned ray_count = 1024 * 16;
+
+  GpuMapTestParams params;
+  params.batch_size = 1024u * 2;
+  params.gpu_mem_size = 256u * 1024u * 1024;
+  params.pipeline_depth = GpuMap::maxPipelineDepth();
+  params.gpu_flags = gpumap::kGpuAllowMappedBuffers | gpumap::kGpuTransferQueue;
+
+  // Make some rays.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpuMapTest(params, rays, compareCpuGpuMaps, "transfer-queue-");
+}
+
+TEST(GpuMap, PopulateStreamed)
+{
+  const double map_extents = 25.0;
+  const unsigned ray_count = 1024 * 16;
+
+  // Submit small packets, coalesced into larger GPU batches.
+  GpuMapTestParams params;
+  params.batch_size = 24u;
+  params.stream_batch_size = 4096u;
+
+  // Make some rays.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpuMapTest(params, rays, compareCpuGpuMaps, "streamed");
+
+  // Validate pending rays are accumulated and flushed.
+  OccupancyMap map(params.resolution);
+  GpuMap gpu_map(&map, true, params.stream_batch_size);
+  gpu_map.setStreamBatchSize(params.stream_batch_size);
+  EXPECT_EQ(gpu_map.streamBatchSize(), params.stream_batch_size);
+  EXPECT_EQ(gpu_map.integrateRays(rays.data(), params.batch_size * 2), params.batch_size * 2);
+  EXPECT_EQ(gpu_map.pendingStreamCount(), params.batch_size * 2);
+  EXPECT_GT(gpu_map.flushStream(), 0u);
+  EXPECT_EQ(gpu_map.pendingStreamCount(), 0u);
+  // Packets with mismatched flags are not combined.
+  gpu_map.integrateRays(rays.data(), params.batch_size * 2);
+  gpu_map.integrateRays(rays.data(), params.batch_size * 2, nullptr, nullptr, kRfExcludeSample);
+  EXPECT_EQ(gpu_map.pendingStreamCount(), params.batch_size * 2);
+  gpu_map.syncVoxels();
+  EXPECT_EQ(gpu_map.pendingStreamCount(), 0u);
+}
+
+TEST(GpuMap, PopulateLocalRays)
+{
+  const double resolution = 0.25;
+  const double sample_range = 20.0;
+  const unsigned sample_count = 1024 * 16;
+
+  // A moving, rotating sensor trajectory.
+  const std::vector<double> transform_times = { 0.0, 0.5, 1.0 };
+  const std::vector<glm::dvec3> transform_translations = { glm::dvec3(0.1, 0.2, 0.3), glm::dvec3(2.1, 1.2, 0.3),
+                                                           glm::dvec3(4.1, 1.7, 0.8) };
+  const std::vector<glm::dquat> transform_rotations = {
+    glm::dquat(1, 0, 0, 0), glm::angleAxis(0.5 * glm::pi<double>(), glm::dvec3(0, 0, 1)),
+    glm::angleAxis(glm::pi<double>(), glm::dvec3(0, 0, 1))
+  };
+
+  // Make sensor frame samples and the equivalent map frame rays.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-sample_range, sample_range);
+  std::vector<double> sample_times(sample_count);
+  std::vector<glm::dvec3> local_samples(sample_count);
+  std::vector<glm::dvec3> rays;
+  for (unsigned i = 0; i < sample_count; ++i)
+  {
+    sample_times[i] = double(i) / double(sample_count);
+    local_samples[i] = glm::dvec3(rand(rand_engine), rand(rand_engine), 0.2 * rand(rand_engine));
+
+    const unsigned from = (sample_times[i] < transform_times[1]) ? 0u : 1u;
+    const double t = (sample_times[i] - transform_times[from]) / (transform_times[from + 1] - transform_times[from]);
+    const glm::dvec3 position = glm::mix(transform_translations[from], transform_translations[from + 1], t);
+    const glm::dquat rotation = glm::slerp(transform_rotations[from], transform_rotations[from + 1], t);
+    rays.emplace_back(position);
+    rays.emplace_back(position + rotation * local_samples[i]);
+  }
+
+  // Add a bad sample, rejected on GPU.
+  local_samples.back() = glm::dvec3(std::numeric_limits<double>::quiet_NaN());
+  rays.resize(rays.size() - 2);
+
+  OccupancyMap reference_map(resolution);
+  OccupancyMap test_map(resolution);
+  {
+    GpuMap reference_mapper(&reference_map, true, sample_count * 2);
+    reference_mapper.integrateRays(rays.data(), rays.size());
+    reference_mapper.syncVoxels();
+
+    GpuMap test_mapper(&test_map, true, sample_count * 2);
+    const size_t integrated = test_mapper.integrateLocalRays(
+      transform_times.data(), transform_translations.data(), transform_rotations.data(), transform_times.size(),
+      sample_times.data(), local_samples.data(), local_samples.size());
+    EXPECT_EQ(integrated, sample_count - 1);
+    test_mapper.syncVoxels();
+  }
+
+  // Small differences are expected from single precision transformation on GPU.
+  compareMaps(reference_map, test_map);
+}
+
 TEST(GpuMap, PopulateSmallCache)
 {
   const double map_extents = 50.0;
@@ -397,6 +652,490 @@ TEST(GpuMap, PopulateSmallCache)
   gpuMapTest(params, rays, PostGpuMapTestFunc(), "small-cache-");
 }
 
+TEST(GpuMap, EvictionPrefetch)
+{
+  // Move a sensor along a line using a small GPU cache to force evictions. Validate each eviction policy, with
+  // prefetch along the predicted trajectory, against a map using the default policy and no prefetch.
+  const double sensor_range = 20.0;
+  const double speed = 0.5;
+  const double resolution = 0.25;
+  const unsigned batch_count = 64;
+  const unsigned batch_size = 1024 * 2;  // Must be even
+  const size_t target_gpu_cache_size = GpuCache::kMiB * 64;
+  const glm::u8vec3 region_size(32);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-sensor_range, sensor_range);
+
+  const auto sensor_position = [speed](unsigned batch) { return glm::dvec3(speed * batch, 0.05, 0.05); };
+
+  std::vector<glm::dvec3> rays;
+  while (rays.size() < batch_count * batch_size)
+  {
+    const glm::dvec3 origin = sensor_position(unsigned(rays.size() / batch_size));
+    rays.emplace_back(origin);
+    rays.emplace_back(origin + glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap reference_map(resolution, region_size);
+  {
+    GpuMap gpu_map(&reference_map, true, batch_size, target_gpu_cache_size);  // Borrow pointer.
+    for (unsigned i = 0; i < rays.size(); i += batch_size)
+    {
+      gpu_map.integrateRays(rays.data() + i, batch_size);
+    }
+    gpu_map.syncVoxels();
+  }
+
+  const GpuLayerCacheEviction policies[] = { kGceLru, kGceFrequency, kGceMotion };
+  for (const GpuLayerCacheEviction policy : policies)
+  {
+    std::cout << "Eviction policy " << int(policy) << std::endl;
+    OccupancyMap map(resolution, region_size);
+    GpuMap gpu_map(&map, true, batch_size, target_gpu_cache_size);  // Borrow pointer.
+    ASSERT_NE(gpu_map.gpuCache(), nullptr);
+    GpuCache &gpu_cache = *gpu_map.gpuCache();
+    gpu_cache.setEvictionPolicy(policy);
+    ASSERT_EQ(gpu_cache.evictionPolicy(), policy);
+
+    unsigned prefetch_count = 0;
+    for (unsigned i = 0; i < rays.size(); i += batch_size)
+    {
+      const unsigned batch = i / batch_size;
+      const glm::dvec3 trajectory[] = { sensor_position(batch + 1), sensor_position(batch + 4) };
+      prefetch_count += gpu_cache.prefetch(trajectory, 2, sensor_range);
+      gpu_map.integrateRays(rays.data() + i, batch_size);
+    }
+    gpu_map.syncVoxels();
+
+    GpuCacheStats stats;
+    gpu_cache.layerCache(kGcIdOccupancy)->queryStats(&stats);
+    EXPECT_GE(stats.prefetches, stats.prefetch_hits);
+    std::cout << "prefetch queued " << prefetch_count << " layer prefetches " << stats.prefetches << " hits "
+              << stats.prefetch_hits << " misses " << stats.misses << std::endl;
+
+    compareMaps(reference_map, map);
+  }
+}
+
+TEST(GpuMap, DirtySpanSync)
+{
+  // Populate a map, then make a sparse update touching very few voxels. The sparse update should only sync the
+  // modified spans of each region back to host. Validate against a CPU map.
+  const double map_extents = 10.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 4;
+  const glm::u8vec3 region_size(32);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  const std::vector<glm::dvec3> sparse_rays = { glm::dvec3(0.05), glm::dvec3(1.1, 0.05, 0.05) };
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), rays.size());
+  cpu_mapper.integrateRays(sparse_rays.data(), sparse_rays.size());
+
+  OccupancyMap map(resolution, region_size);
+  GpuMap gpu_map(&map, true, unsigned(rays.size()));  // Borrow pointer.
+  gpu_map.integrateRays(rays.data(), rays.size());
+  gpu_map.syncVoxels();
+
+  GpuCacheStats initial_stats;
+  GpuLayerCache &occupancy_cache = *gpu_map.gpuCache()->layerCache(kGcIdOccupancy);
+  occupancy_cache.queryStats(&initial_stats);
+
+  gpu_map.integrateRays(sparse_rays.data(), sparse_rays.size());
+  gpu_map.syncVoxels();
+
+  GpuCacheStats stats;
+  occupancy_cache.queryStats(&stats);
+  EXPECT_GT(stats.partial_syncs, initial_stats.partial_syncs);
+
+  compareMaps(cpu_map, map);
+}
+
+TEST(GpuMap, UnifiedMemory)
+{
+  // Populate using unified cache memory where the device supports it. The cache falls back to device memory otherwise,
+  // so the results must match a CPU map either way.
+  const double map_extents = 10.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 4;
+  const glm::u8vec3 region_size(32);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), rays.size());
+
+  OccupancyMap map(resolution, region_size);
+  // Enable GPU before creating the GpuMap so our flags are used.
+  gpumap::enableGpu(map, GpuCache::kDefaultLayerMemSize, gpumap::kGpuUnifiedMemory);
+  GpuMap gpu_map(&map, true, unsigned(rays.size()));  // Borrow pointer.
+
+  GpuLayerCache &occupancy_cache = *gpu_map.gpuCache()->layerCache(kGcIdOccupancy);
+  std::cout << "unified memory: " << (occupancy_cache.unifiedMemory() ? "yes" : "no") << std::endl;
+  EXPECT_TRUE(!occupancy_cache.unifiedMemory() || gpu_map.gpuCache()->gpu().unifiedMemory());
+
+  // Integrate in two halves so the second pass updates regions already resident in the cache.
+  const size_t half_count = (rays.size() / 4) * 2;
+  gpu_map.integrateRays(rays.data(), half_count);
+  gpu_map.integrateRays(rays.data() + half_count, rays.size() - half_count);
+  gpu_map.syncVoxels();
+
+  compareMaps(cpu_map, map);
+}
+
+TEST(GpuMap, RegionTable)
+{
+  // Move a sensor along a line using a small GPU cache to force evictions, then validate the region table maps
+  // exactly the cached regions to their cache slots.
+  const double sensor_range = 8.0;
+  const double speed = 0.5;
+  const double resolution = 0.25;
+  const unsigned batch_count = 64;
+  const unsigned batch_size = 1024;  // Must be even
+  const size_t target_gpu_cache_size = GpuCache::kMiB * 4;
+  const glm::u8vec3 region_size(16);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-sensor_range, sensor_range);
+
+  std::vector<glm::dvec3> rays;
+  while (rays.size() < batch_count * batch_size)
+  {
+    const glm::dvec3 origin(speed * double(rays.size() / batch_size), 0.05, 0.05);
+    rays.emplace_back(origin);
+    rays.emplace_back(origin + glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), rays.size());
+
+  OccupancyMap map(resolution, region_size);
+  // Enable GPU before creating the GpuMap so our flags are used.
+  gpumap::enableGpu(map, target_gpu_cache_size, gpumap::kGpuAllowMappedBuffers | gpumap::kGpuRegionTable);
+  GpuMap gpu_map(&map, true, batch_size);  // Borrow pointer.
+
+  GpuLayerCache &occupancy_cache = *gpu_map.gpuCache()->layerCache(kGcIdOccupancy);
+  ASSERT_TRUE(occupancy_cache.hasRegionTable());
+  ASSERT_NE(occupancy_cache.regionTableBuffer(), nullptr);
+  const unsigned capacity = occupancy_cache.regionTableCapacity();
+  EXPECT_GE(capacity, 2u * occupancy_cache.cacheSize());
+  EXPECT_EQ(capacity & (capacity - 1u), 0u);
+
+  for (size_t i = 0; i < rays.size(); i += batch_size)
+  {
+    gpu_map.integrateRays(rays.data() + i, std::min<size_t>(batch_size, rays.size() - i));
+  }
+
+  GpuCacheStats stats;
+  occupancy_cache.queryStats(&stats);
+  EXPECT_GT(stats.full, 0u);
+
+  occupancy_cache.syncRegionTable();
+  std::vector<RegionTableEntry> table(capacity);
+  occupancy_cache.regionTableBuffer()->read(table.data(), table.size() * sizeof(RegionTableEntry));
+
+  unsigned used_count = 0;
+  for (unsigned i = 0; i < capacity; ++i)
+  {
+    const RegionTableEntry &entry = table[i];
+    if (!entry.used)
+    {
+      continue;
+    }
+    ++used_count;
+
+    const glm::i16vec3 region_key(entry.region[0], entry.region[1], entry.region[2]);
+    size_t mem_offset = 0;
+    ASSERT_TRUE(occupancy_cache.lookup(map, region_key, &mem_offset));
+    EXPECT_EQ(entry.slot, unsigned(mem_offset / occupancy_cache.chunkSize()));
+
+    // The entry must be reachable by probing from its hash without crossing an unused entry.
+    unsigned index = regionTableHash(region_key.x, region_key.y, region_key.z) & (capacity - 1u);
+    while (index != i)
+    {
+      ASSERT_TRUE(table[index].used);
+      index = (index + 1u) & (capacity - 1u);
+    }
+  }
+  EXPECT_EQ(used_count, occupancy_cache.cachedCount());
+
+  gpu_map.syncVoxels();
+  compareMaps(cpu_map, map);
+}
+
+TEST(GpuMap, PackedOccupancy)
+{
+  // Populate using a packed occupancy cache with a small cache size to force evictions. The packed cache must hold
+  // twice the regions of a float cache and the results must match a CPU map within the quantisation error.
+  const double map_extents = 10.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 4;
+  const size_t target_gpu_cache_size = GpuCache::kMiB * 4;
+  const glm::u8vec3 region_size(16);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), rays.size());
+
+  OccupancyMap float_map(resolution, region_size);
+  gpumap::enableGpu(float_map, target_gpu_cache_size, gpumap::kGpuAllowMappedBuffers);
+  const unsigned float_cache_size = gpumap::gpuCache(float_map)->layerCache(kGcIdOccupancy)->cacheSize();
+
+  OccupancyMap map(resolution, region_size);
+  // Enable GPU before creating the GpuMap so our flags are used.
+  gpumap::enableGpu(map, target_gpu_cache_size, gpumap::kGpuAllowMappedBuffers | gpumap::kGpuPackedOccupancy);
+  GpuMap gpu_map(&map, true, 1024);  // Borrow pointer.
+
+  GpuLayerCache &occupancy_cache = *gpu_map.gpuCache()->layerCache(kGcIdOccupancy);
+  ASSERT_TRUE(occupancy_cache.packedOccupancy());
+  EXPECT_EQ(size_t(occupancy_cache.chunkSize()), map.regionVoxelVolume() * 2u);
+  EXPECT_GE(occupancy_cache.cacheSize(), 2u * float_cache_size - 1u);
+
+  for (size_t i = 0; i < rays.size(); i += 1024)
+  {
+    gpu_map.integrateRays(rays.data() + i, std::min<size_t>(1024, rays.size() - i));
+  }
+  gpu_map.syncVoxels();
+
+  compareMaps(cpu_map, map);
+}
+
+TEST(GpuMap, Resident)
+{
+  // Populate in GPU resident mode. No host regions may be created until we sync, at which point the map must match a
+  // CPU map.
+  const double map_extents = 10.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 4;
+  const glm::u8vec3 region_size(16);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), rays.size());
+
+  OccupancyMap map(resolution, region_size);
+  // Enable GPU before creating the GpuMap so our flags are used.
+  gpumap::enableGpu(map, GpuCache::kDefaultLayerMemSize, gpumap::kGpuAllowMappedBuffers | gpumap::kGpuResident);
+  GpuMap gpu_map(&map, true, 1024);  // Borrow pointer.
+  ASSERT_TRUE(gpu_map.gpuCache()->layerCache(kGcIdOccupancy)->resident());
+
+  for (size_t i = 0; i < rays.size(); i += 1024)
+  {
+    gpu_map.integrateRays(rays.data() + i, std::min<size_t>(1024, rays.size() - i));
+  }
+  EXPECT_EQ(map.regionCount(), 0u);
+
+  gpu_map.syncVoxels();
+  EXPECT_EQ(map.regionCount(), cpu_map.regionCount());
+  compareMaps(cpu_map, map);
+
+  // Move a sensor along a line with a small cache to force evictions. Evicted regions gain host shadows, while the
+  // cached regions remain GPU only until we sync.
+  const double speed = 0.5;
+  const unsigned batch_count = 64;
+  const unsigned batch_size = 1024;  // Must be even
+  std::vector<glm::dvec3> moving_rays;
+  while (moving_rays.size() < batch_count * batch_size)
+  {
+    const glm::dvec3 origin(speed * double(moving_rays.size() / batch_size), 0.05, 0.05);
+    moving_rays.emplace_back(origin);
+    moving_rays.emplace_back(origin + glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap moving_cpu_map(resolution, region_size);
+  RayMapperOccupancy moving_cpu_mapper(&moving_cpu_map);
+  moving_cpu_mapper.integrateRays(moving_rays.data(), moving_rays.size());
+
+  OccupancyMap moving_map(resolution, region_size);
+  gpumap::enableGpu(moving_map, GpuCache::kMiB * 4, gpumap::kGpuAllowMappedBuffers | gpumap::kGpuResident);
+  GpuMap moving_gpu_map(&moving_map, true, batch_size);  // Borrow pointer.
+
+  for (size_t i = 0; i < moving_rays.size(); i += batch_size)
+  {
+    moving_gpu_map.integrateRays(moving_rays.data() + i, std::min<size_t>(batch_size, moving_rays.size() - i));
+  }
+
+  GpuCacheStats stats;
+  moving_gpu_map.gpuCache()->layerCache(kGcIdOccupancy)->queryStats(&stats);
+  EXPECT_GT(stats.full, 0u);
+  EXPECT_GT(moving_map.regionCount(), 0u);
+  EXPECT_LT(moving_map.regionCount(), moving_cpu_map.regionCount());
+
+  moving_gpu_map.syncVoxels();
+  compareMaps(moving_cpu_map, moving_map);
+}
+
+TEST(GpuMap, SyncVoxelsAsync)
+{
+  // Take an asynchronous snapshot after integrating half the rays, then integrate the rest. The snapshot must match a
+  // CPU map populated with the first half only.
+  const double map_extents = 10.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 4;
+  const glm::u8vec3 region_size(32);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+  const size_t half_count = rays.size() / 2;
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), half_count);
+
+  OccupancyMap map(resolution, region_size);
+  GpuMap gpu_map(&map, true, unsigned(half_count));  // Borrow pointer.
+  gpu_map.integrateRays(rays.data(), half_count);
+  std::shared_ptr<GpuMapSnapshot> snapshot = gpu_map.syncVoxelsAsync();
+  ASSERT_NE(snapshot, nullptr);
+  gpu_map.integrateRays(rays.data() + half_count, rays.size() - half_count);
+
+  snapshot->wait();
+  EXPECT_TRUE(snapshot->isReady());
+
+  const int occupancy_layer = map.layout().occupancyLayer();
+  ASSERT_TRUE(snapshot->hasLayer(occupancy_layer));
+  ASSERT_EQ(snapshot->regionByteSize(occupancy_layer), map.regionVoxelVolume() * sizeof(float));
+
+  std::vector<glm::i16vec3> region_keys;
+  snapshot->regionKeys(occupancy_layer, region_keys);
+  EXPECT_FALSE(region_keys.empty());
+
+  // Allow for some discrepancies as the GPU map is non-deterministic. See compareMaps().
+  unsigned processed = 0;
+  unsigned failures = 0;
+  for (const auto &region_key : region_keys)
+  {
+    const auto *voxels = reinterpret_cast<const float *>(snapshot->voxels(occupancy_layer, region_key));
+    ASSERT_NE(voxels, nullptr);
+    const MapChunk *cpu_chunk = cpu_map.region(region_key, false);
+    if (!cpu_chunk)
+    {
+      continue;
+    }
+
+    VoxelBuffer<const VoxelBlock> cpu_voxels(cpu_chunk->voxel_blocks[occupancy_layer]);
+    const auto *expect = reinterpret_cast<const float *>(cpu_voxels.voxelMemory());
+    for (size_t i = 0; i < map.regionVoxelVolume(); ++i)
+    {
+      if (expect[i] == unobservedOccupancyValue())
+      {
+        continue;
+      }
+      ++processed;
+      if (voxels[i] == unobservedOccupancyValue() || std::abs(expect[i] - voxels[i]) >= cpu_map.hitValue() * 0.5f)
+      {
+        ++failures;
+      }
+    }
+  }
+  EXPECT_GT(processed, 0u);
+  EXPECT_LE(failures, processed / 100u);
+
+  // The held snapshot must not be reused.
+  std::shared_ptr<GpuMapSnapshot> snapshot2 = gpu_map.syncVoxelsAsync();
+  std::shared_ptr<GpuMapSnapshot> snapshot3 = gpu_map.syncVoxelsAsync();
+  EXPECT_NE(snapshot2, snapshot);
+  EXPECT_NE(snapshot3, snapshot);
+  EXPECT_NE(snapshot3, snapshot2);
+  snapshot2->wait();
+  snapshot3->wait();
+}
+
+TEST(GpuMap, Profile)
+{
+  // Populate with GPU profiling enabled. This must not affect the results and must collect timing for the update
+  // kernel and the region uploads.
+  const double map_extents = 10.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 4;
+  const glm::u8vec3 region_size(32);
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap cpu_map(resolution, region_size);
+  RayMapperOccupancy cpu_mapper(&cpu_map);
+  cpu_mapper.integrateRays(rays.data(), rays.size());
+
+  OccupancyMap map(resolution, region_size);
+  // Enable GPU before creating the GpuMap so our flags are used.
+  gpumap::enableGpu(map, GpuCache::kDefaultLayerMemSize, gpumap::kGpuAllowMappedBuffers | gpumap::kGpuProfile);
+  GpuMap gpu_map(&map, true, unsigned(rays.size()));  // Borrow pointer.
+
+  gputil::Profiler *profiler = gpu_map.gpuCache()->profiler();
+  ASSERT_NE(profiler, nullptr);
+
+  const size_t half_count = (rays.size() / 4) * 2;
+  gpu_map.integrateRays(rays.data(), half_count);
+  gpu_map.integrateRays(rays.data() + half_count, rays.size() - half_count);
+  gpu_map.syncVoxels();
+
+  compareMaps(cpu_map, map);
+
+  EXPECT_GE(profiler->batchCount(), 2u);
+  const std::vector<gputil::ProfileStats> &stats = profiler->stats();
+  EXPECT_EQ(profiler->pendingCount(), 0u);
+  bool have_kernel = false;
+  bool have_upload = false;
+  for (const gputil::ProfileStats &item : stats)
+  {
+    std::cout << item.name << ": " << item.count << " call(s) " << item.exec_ns << "ns " << item.bytes << "B"
+              << std::endl;
+    have_kernel = have_kernel || (item.name == "region update" && item.count > 0);
+    have_upload = have_upload || (item.name == "ray upload" && item.count > 0 && item.bytes > 0);
+  }
+  EXPECT_TRUE(have_kernel);
+  EXPECT_TRUE(have_upload);
+}
+
 TEST(GpuMap, PopulateMultiple)
 {
   // Test having multiple GPU maps operating at once to ensure we don't get any GPU management issues.
@@ -456,6 +1195,122 @@ TEST(GpuMap, PopulateMultiple)
   compareMaps(map1, map3);
 }
 
+TEST(GpuMap, MultiDevice)
+{
+  // Compare a map sharded across multiple devices against a single device map. We repeat the default device when
+  // there are fewer than two GPUs to still exercise sharding.
+  const double map_extents = 50.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 8;
+  const unsigned batch_size = 1024 * 2;  // Must be even
+  const size_t target_gpu_cache_size = GpuCache::kMiB * 200;
+  const glm::u8vec3 region_size(32);
+  // Make some rays.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  std::vector<gputil::Device> devices;
+  GpuMultiMap::enumerateDevices(devices);
+  while (devices.size() < 2)
+  {
+    devices.emplace_back(ohm::gpuDevice());
+  }
+
+  OccupancyMap reference_map(resolution, region_size);
+  OccupancyMap multi_map(resolution, region_size);
+  {
+    GpuMap gpu_map(&reference_map, true, batch_size, target_gpu_cache_size);  // Borrow pointer.
+    GpuMultiMap gpu_multi_map(&multi_map, devices, batch_size, target_gpu_cache_size);  // Borrow pointer.
+    ASSERT_TRUE(gpu_multi_map.valid());
+    ASSERT_EQ(gpu_multi_map.deviceCount(), unsigned(devices.size()));
+
+    for (unsigned i = 0; i < rays.size(); i += batch_size)
+    {
+      const unsigned remaining = unsigned(rays.size() - i);
+      const unsigned current_batch_size = std::min(batch_size, remaining);
+      gpu_map.integrateRays(rays.data() + i, current_batch_size);
+      gpu_multi_map.integrateRays(rays.data() + i, current_batch_size);
+    }
+
+    gpu_map.syncVoxels();
+    gpu_multi_map.syncVoxels();
+  }
+
+  std::cout << "Comparing maps" << std::endl;
+  compareMaps(reference_map, multi_map);
+}
+
+TEST(GpuMap, Hybrid)
+{
+  // Compare a map split between GPU and CPU against a GPU only map. We explicitly migrate regions both ways during
+  // population and rebalance on every batch to exercise cache coherence.
+  const double map_extents = 50.0;
+  const double resolution = 0.25;
+  const unsigned ray_count = 1024 * 8;
+  const unsigned batch_size = 1024 * 2;  // Must be even
+  const size_t target_gpu_cache_size = GpuCache::kMiB * 200;
+  const glm::u8vec3 region_size(32);
+  // Make some rays.
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-map_extents, map_extents);
+  std::vector<glm::dvec3> rays;
+
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.05));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  OccupancyMap reference_map(resolution, region_size);
+  OccupancyMap hybrid_map(resolution, region_size);
+  {
+    GpuMap gpu_map(&reference_map, true, batch_size, target_gpu_cache_size);  // Borrow pointer.
+    GpuHybridMap gpu_hybrid_map(&hybrid_map, batch_size, target_gpu_cache_size, 0.5f);  // Borrow pointer.
+    ASSERT_TRUE(gpu_hybrid_map.valid());
+    EXPECT_EQ(gpu_hybrid_map.cpuBins(), unsigned(GpuHybridMap::kOwnershipBins / 2));
+    gpu_hybrid_map.setDynamicBalance(false);
+
+    unsigned batch_index = 0;
+    for (unsigned i = 0; i < rays.size(); i += batch_size, ++batch_index)
+    {
+      const unsigned remaining = unsigned(rays.size() - i);
+      const unsigned current_batch_size = std::min(batch_size, remaining);
+      gpu_map.integrateRays(rays.data() + i, current_batch_size);
+      gpu_hybrid_map.integrateRays(rays.data() + i, current_batch_size);
+
+      // Migrate regions to the CPU, back to the GPU, then let the dynamic balance take over.
+      if (batch_index == 0)
+      {
+        gpu_hybrid_map.setCpuShare(0.75f);
+      }
+      else if (batch_index == 1)
+      {
+        gpu_hybrid_map.setCpuShare(0.25f);
+        gpu_hybrid_map.setRebalanceInterval(1);
+        gpu_hybrid_map.setDynamicBalance(true);
+      }
+    }
+
+    EXPECT_GT(gpu_hybrid_map.cpuRayRate(), 0.0);
+    EXPECT_GT(gpu_hybrid_map.gpuRayRate(), 0.0);
+    EXPECT_GE(gpu_hybrid_map.cpuBins(), 1u);
+    EXPECT_LT(gpu_hybrid_map.cpuBins(), unsigned(GpuHybridMap::kOwnershipBins));
+
+    gpu_map.syncVoxels();
+    gpu_hybrid_map.syncVoxels();
+  }
+
+  std::cout << "Comparing maps" << std::endl;
+  compareMaps(reference_map, hybrid_map);
+}
+
 TEST(GpuMap, PopulateSegmented)
 {
   // Populate a map with long rays being segmented into multiple, smaller parts.
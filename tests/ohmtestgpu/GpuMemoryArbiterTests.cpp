@@ -0,0 +1,114 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohm/OccupancyMap.h>
+#include <ohmgpu/GpuCache.h>
+#include <ohmgpu/GpuLayerCache.h>
+#include <ohmgpu/GpuMap.h>
+#include <ohmgpu/GpuMemoryArbiter.h>
+#include <ohmgpu/OhmGpu.h>
+
+#include <glm/glm.hpp>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace gpumemoryarbitertests
+{
+TEST(GpuMemoryArbiter, Budgets)
+{
+  ohm::GpuMemoryArbiter arbiter(ohm::gpuDevice(), 1000u);
+  size_t budget_a = 0;
+  size_t budget_b = 0;
+
+  // Elastic consumers share the budget in proportion to their requests above their minimum.
+  ohm::GpuMemoryConsumer consumer_a(arbiter, "a", 800u, 200u, [&budget_a](size_t budget) { budget_a = budget; });
+  ohm::GpuMemoryConsumer consumer_b(arbiter, "b", 400u, 100u, [&budget_b](size_t budget) { budget_b = budget; });
+  EXPECT_NEAR(double(consumer_a.budget()), 200.0 + 600.0 * 7.0 / 9.0, 1.0);
+  EXPECT_NEAR(double(consumer_b.budget()), 100.0 + 300.0 * 7.0 / 9.0, 1.0);
+  EXPECT_EQ(budget_a, consumer_a.budget());
+  EXPECT_EQ(budget_b, consumer_b.budget());
+
+  // Fixed consumers are allotted their reported usage, evicting from the elastic consumers.
+  ohm::GpuMemoryConsumer consumer_c(arbiter, "c", 0u, 0u);
+  consumer_c.reportUsage(400u);
+  EXPECT_EQ(consumer_c.budget(), 400u);
+  EXPECT_NEAR(double(budget_a), 400.0, 1.0);
+  EXPECT_NEAR(double(budget_b), 200.0, 1.0);
+
+  // Elastic consumers never drop below their minimum.
+  consumer_c.reportUsage(2000u);
+  EXPECT_EQ(budget_a, 200u);
+  EXPECT_EQ(budget_b, 100u);
+
+  ohm::GpuMemoryUsage usage = arbiter.usage();
+  EXPECT_EQ(usage.total_budget, 1000u);
+  EXPECT_EQ(usage.allotted, 2300u);
+  EXPECT_EQ(usage.used, 2000u);
+  ASSERT_EQ(usage.consumers.size(), 3u);
+  EXPECT_TRUE(usage.consumers[0].elastic);
+  EXPECT_FALSE(usage.consumers[2].elastic);
+
+  // Releasing the fixed consumer restores the elastic budgets.
+  consumer_c.release();
+  EXPECT_NEAR(double(budget_a), 200.0 + 600.0 * 7.0 / 9.0, 1.0);
+  EXPECT_NEAR(double(budget_b), 100.0 + 300.0 * 7.0 / 9.0, 1.0);
+
+  // Everything fits.
+  arbiter.setTotalBudget(2000u);
+  EXPECT_EQ(budget_a, 800u);
+  EXPECT_EQ(budget_b, 400u);
+}
+
+
+TEST(GpuMemoryArbiter, GpuCacheBudget)
+{
+  ohm::OccupancyMap map(0.1);
+  ohm::GpuMap gpu_map(&map, true);
+
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-5.0, 5.0);
+  std::vector<glm::dvec3> rays;
+  for (unsigned i = 0; i < 1024u; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  gpu_map.integrateRays(rays.data(), rays.size());
+
+  ohm::GpuCache *gpu_cache = gpu_map.gpuCache();
+  ASSERT_NE(gpu_cache, nullptr);
+  ohm::GpuLayerCache *occupancy_cache = gpu_cache->layerCache(ohm::kGcIdOccupancy);
+  ASSERT_NE(occupancy_cache, nullptr);
+  const unsigned initial_cache_size = occupancy_cache->cacheSize();
+  const size_t initial_target = gpu_cache->targetGpuAllocSize();
+
+  // Restrict the total budget so the cache must shrink to half its requested size.
+  ohm::GpuMemoryArbiter &arbiter = ohm::GpuMemoryArbiter::forDevice(gpu_cache->gpu());
+  const size_t restore_budget = arbiter.totalBudget();
+  const size_t other_usage = arbiter.usage().allotted - gpu_cache->memoryConsumer().budget();
+  arbiter.setTotalBudget(other_usage + gpu_cache->requestedGpuAllocSize() / 2);
+  EXPECT_TRUE(gpu_cache->memoryBudgetPending());
+
+  // The budget is applied on the next batch.
+  gpu_map.integrateRays(rays.data(), rays.size());
+  EXPECT_FALSE(gpu_cache->memoryBudgetPending());
+  EXPECT_LT(gpu_cache->targetGpuAllocSize(), initial_target);
+  EXPECT_LT(occupancy_cache->cacheSize(), initial_cache_size);
+
+  // The map content survives the reallocation.
+  gpu_map.syncVoxels();
+  EXPECT_GT(map.regionCount(), 0u);
+
+  // Restore the budget, growing the cache again.
+  arbiter.setTotalBudget(restore_budget);
+  gpu_map.integrateRays(rays.data(), rays.size());
+  EXPECT_EQ(gpu_cache->targetGpuAllocSize(), initial_target);
+  EXPECT_EQ(occupancy_cache->cacheSize(), initial_cache_size);
+}
+}  // namespace gpumemoryarbitertests
@@ -0,0 +1,108 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohm/MapFlag.h>
+#include <ohm/NearestNeighboursBatch.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+#include <ohmgpu/NearestNeighboursGpu.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace nearestneighboursgputests
+{
+void compareResults(const ohm::NearestNeighboursBatch &expected, const ohm::NearestNeighboursGpu &actual)
+{
+  ASSERT_EQ(actual.numberOfResults(), expected.numberOfResults());
+  for (size_t i = 0; i < expected.numberOfResults(); ++i)
+  {
+    ASSERT_EQ(actual.resultCounts()[i], expected.resultCounts()[i]) << i;
+
+    const size_t expected_offset = expected.resultIndices()[i];
+    const size_t actual_offset = actual.resultIndices()[i];
+    if (expected.queryFlags() & ohm::kQfNearestResult)
+    {
+      // Ties may resolve to different voxels. Compare the range only.
+      if (expected.resultCounts()[i])
+      {
+        EXPECT_NEAR(actual.ranges()[actual_offset], expected.ranges()[expected_offset], 1e-5) << i;
+      }
+      continue;
+    }
+
+    std::vector<ohm::Key> expected_keys(expected.intersectedVoxels() + expected_offset,
+                                        expected.intersectedVoxels() + expected_offset + expected.resultCounts()[i]);
+    std::vector<ohm::Key> actual_keys(actual.intersectedVoxels() + actual_offset,
+                                      actual.intersectedVoxels() + actual_offset + actual.resultCounts()[i]);
+    std::sort(expected_keys.begin(), expected_keys.end());
+    std::sort(actual_keys.begin(), actual_keys.end());
+    ASSERT_EQ(actual_keys, expected_keys) << i;
+  }
+}
+
+
+void testNearestNeighbours(ohm::MapFlag map_flags)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap map(resolution, glm::u8vec3(16), map_flags);
+
+  // Scatter occupied and free voxels over a few regions.
+  std::mt19937 rand_engine(0x1234);  // NOLINT(readability-magic-numbers)
+  std::uniform_real_distribution<double> rand(-2.0, 2.0);
+  for (unsigned i = 0; i < 4000; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    const ohm::Key key = map.voxelKey(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+    if (i % 3)
+    {
+      ohm::integrateHit(map, key);
+    }
+    else
+    {
+      ohm::integrateMiss(map, key);
+    }
+  }
+
+  // Include points outside the populated regions.
+  std::uniform_real_distribution<double> rand_query(-3.0, 3.0);
+  std::vector<glm::dvec3> points;
+  for (unsigned i = 0; i < 600; ++i)  // NOLINT(readability-magic-numbers)
+  {
+    points.emplace_back(glm::dvec3(rand_query(rand_engine), rand_query(rand_engine), rand_query(rand_engine)));
+  }
+
+  const float search_radius = 0.35f;  // NOLINT(readability-magic-numbers)
+  for (unsigned flags : { 0u, unsigned(ohm::kQfNearestResult), unsigned(ohm::kQfUnknownAsOccupied) })
+  {
+    ohm::NearestNeighboursBatch cpu_query(map, search_radius, flags);
+    cpu_query.setNearPoints(points.data(), points.size());
+    ASSERT_TRUE(cpu_query.execute());
+
+    ohm::NearestNeighboursGpu gpu_query(map, search_radius, flags | ohm::kQfGpuEvaluate);
+    gpu_query.setNearPoints(points.data(), points.size());
+    ASSERT_TRUE(gpu_query.execute());
+    compareResults(cpu_query, gpu_query);
+
+    // Execute again to validate resetting the results and reusing the GPU resources.
+    ASSERT_TRUE(gpu_query.execute());
+    compareResults(cpu_query, gpu_query);
+  }
+}
+
+
+TEST(NearestNeighboursGpu, RowMajor)
+{
+  testNearestNeighbours(ohm::MapFlag::kNone);
+}
+
+
+TEST(NearestNeighboursGpu, Morton)
+{
+  testNearestNeighbours(ohm::MapFlag::kVoxelOrderMorton);
+}
+}  // namespace nearestneighboursgputests
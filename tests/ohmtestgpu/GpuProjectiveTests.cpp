@@ -0,0 +1,92 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohmgpu/GpuCache.h>
+#include <ohmgpu/GpuMap.h>
+#include <ohmgpu/OhmGpu.h>
+#include <ohmgpu/ProjectiveIntegratorGpu.h>
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/ProjectiveIntegrator.h>
+#include <ohm/VoxelData.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+namespace projectivetests
+{
+TEST(Projective, GpuMatchesCpu)
+{
+  const double resolution = 0.1;
+  ohm::OccupancyMap cpu_map(resolution, glm::u8vec3(16), ohm::MapFlag::kTsdf);
+  ohm::OccupancyMap gpu_map(resolution, glm::u8vec3(16), ohm::MapFlag::kTsdf);
+
+  ohm::DepthCamera camera;
+  camera.width = 64;   // NOLINT(readability-magic-numbers)
+  camera.height = 48;  // NOLINT(readability-magic-numbers)
+  camera.fx = camera.fy = 50.0;
+  camera.cx = 31.5;  // NOLINT(readability-magic-numbers)
+  camera.cy = 23.5;  // NOLINT(readability-magic-numbers)
+  camera.max_depth = 5.0;
+
+  ohm::TsdfOptions tsdf_options;
+  tsdf_options.default_truncation_distance = float(3 * resolution);
+
+  // A wall facing the camera between voxel centres.
+  const std::vector<float> depth(size_t(camera.width) * camera.height, 2.02f);
+  const glm::dmat4 camera_to_map = glm::translate(glm::dmat4(1.0), glm::dvec3(0.01, 0.02, 0.0));
+
+  ohm::ProjectiveIntegrator cpu_integrator(&cpu_map);
+  cpu_integrator.setCamera(camera);
+  cpu_integrator.setTsdfOptions(tsdf_options);
+  ASSERT_GT(cpu_integrator.integrate(depth.data(), camera_to_map), 0u);
+
+  ohm::GpuCache *gpu_cache = ohm::gpumap::enableGpu(gpu_map);
+  ASSERT_NE(gpu_cache, nullptr);
+  ohm::ProjectiveIntegratorGpu gpu_integrator(ohm::gpuDevice());
+  gpu_integrator.setCamera(camera);
+  gpu_integrator.setTsdfOptions(tsdf_options);
+  ASSERT_TRUE(gpu_integrator.integrate(gpu_map, depth.data(), camera_to_map));
+  EXPECT_EQ(gpu_integrator.regionCount(), cpu_integrator.regionCount());
+  gpu_cache->flush();
+
+  // The GPU creates every selected region, so compare over the CPU map. Voxels on the frustum boundary may project
+  // differently in single precision, so allow a small number of mismatches.
+  const int tsdf_layer = cpu_map.layout().layerIndex(ohm::default_layer::tsdfLayerName());
+  ohm::Voxel<const float> gpu_occupancy(&gpu_map, gpu_map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::VoxelTsdf> gpu_tsdf(&gpu_map, tsdf_layer);
+  size_t compared = 0;
+  size_t mismatched = 0;
+  for (auto iter = cpu_map.begin(); iter != cpu_map.end(); ++iter)
+  {
+    ohm::Voxel<const float> cpu_occupancy(&cpu_map, cpu_map.layout().occupancyLayer(), *iter);
+    ohm::Voxel<const ohm::VoxelTsdf> cpu_tsdf(&cpu_map, tsdf_layer, *iter);
+    ohm::setVoxelKey(*iter, gpu_occupancy, gpu_tsdf);
+    ASSERT_TRUE(gpu_occupancy.isValid());
+    ASSERT_TRUE(gpu_tsdf.isValid());
+
+    const float cpu_value = cpu_occupancy.data();
+    const float gpu_value = gpu_occupancy.data();
+    const ohm::VoxelTsdf cpu_tsdf_value = cpu_tsdf.data();
+    const ohm::VoxelTsdf gpu_tsdf_value = gpu_tsdf.data();
+    const bool occupancy_match = (std::isinf(cpu_value) || std::isinf(gpu_value)) ?
+                                   cpu_value == gpu_value :
+                                   std::abs(cpu_value - gpu_value) < 1e-4f;
+    const bool tsdf_match = cpu_tsdf_value.weight == gpu_tsdf_value.weight &&
+                            std::abs(cpu_tsdf_value.distance - gpu_tsdf_value.distance) < 1e-3f;
+    mismatched += !(occupancy_match && tsdf_match);
+    ++compared;
+  }
+
+  EXPECT_GT(compared, 0u);
+  EXPECT_LT(mismatched, compared / 100u + 1u);
+}
+}  // namespace projectivetests
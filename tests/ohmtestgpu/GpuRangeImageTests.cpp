@@ -0,0 +1,142 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <ohmgpu/OhmGpu.h>
+#include <ohmgpu/RangeImageGpu.h>
+
+#include <ohm/OccupancyMap.h>
+#include <ohm/VoxelData.h>
+
+#include <gputil/gpuBuffer.h>
+#include <gputil/gpuPinnedBuffer.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace rangeimagetests
+{
+/// Build a square room of occupied walls about the origin. The walls occupy the voxels spanning [4.9, 5) metres from
+/// the origin along X and Y, so a ray from the origin enters a wall at `4.9 / max(|dir.x|, |dir.y|)`.
+void buildRoom(ohm::OccupancyMap &map)
+{
+  const double resolution = map.resolution();
+  const double wall = 4.95;
+  for (double a = -5.0 + 0.5 * resolution; a < 5.0; a += resolution)
+  {
+    for (double z = -2.0 + 0.5 * resolution; z < 2.0; z += resolution)
+    {
+      ohm::integrateHit(map, map.voxelKey(glm::dvec3(wall, a, z)));
+      ohm::integrateHit(map, map.voxelKey(glm::dvec3(-wall, a, z)));
+      ohm::integrateHit(map, map.voxelKey(glm::dvec3(a, wall, z)));
+      ohm::integrateHit(map, map.voxelKey(glm::dvec3(a, -wall, z)));
+    }
+  }
+}
+
+
+TEST(RangeImage, Pinhole)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  buildRoom(map);
+
+  ohm::RangeSensor sensor;
+  sensor.width = 64;   // NOLINT(readability-magic-numbers)
+  sensor.height = 32;  // NOLINT(readability-magic-numbers)
+  sensor.fx = sensor.fy = 50.0;
+  sensor.cx = 31.5;  // NOLINT(readability-magic-numbers)
+  sensor.cy = 15.5;  // NOLINT(readability-magic-numbers)
+  sensor.max_range = 10.0;
+  sensor.depth = true;
+
+  // Look along +X: camera right is -Y, camera down is -Z.
+  glm::dmat4 sensor_to_map(1.0);
+  sensor_to_map[0] = glm::dvec4(0, -1, 0, 0);
+  sensor_to_map[1] = glm::dvec4(0, 0, -1, 0);
+  sensor_to_map[2] = glm::dvec4(1, 0, 0, 0);
+
+  ohm::RangeImageGpu range_image(ohm::gpuDevice());
+  range_image.setSensor(sensor);
+  ASSERT_TRUE(range_image.render(map, sensor_to_map));
+  ASSERT_EQ(range_image.ranges().size(), size_t(sensor.width) * size_t(sensor.height));
+  // Regions without walls are skipped.
+  EXPECT_LT(range_image.occupiedRegionCount(), range_image.gridRegionCount());
+
+  // The depth is constant against the facing wall.
+  for (const float depth : range_image.ranges())
+  {
+    EXPECT_NEAR(depth, 4.9f, 1e-3f);
+  }
+
+  // Render into a GPU buffer and compare.
+  gputil::Buffer output(ohm::gpuDevice(), sizeof(float), gputil::kBfReadWrite);
+  ASSERT_TRUE(range_image.render(map, sensor_to_map, &output));
+  range_image.completionEvent().wait();
+  std::vector<float> output_ranges(size_t(sensor.width) * size_t(sensor.height));
+  gputil::PinnedBuffer pinned(output, gputil::kPinRead);
+  pinned.read(output_ranges.data(), output_ranges.size() * sizeof(float));
+  pinned.unpin();
+  ASSERT_TRUE(range_image.render(map, sensor_to_map));
+  EXPECT_EQ(output_ranges, range_image.ranges());
+
+  // Nothing within range.
+  sensor.max_range = 4.0;
+  range_image.setSensor(sensor);
+  ASSERT_TRUE(range_image.render(map, sensor_to_map));
+  for (const float depth : range_image.ranges())
+  {
+    EXPECT_EQ(depth, 0.0f);
+  }
+}
+
+
+TEST(RangeImage, Spherical)
+{
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  buildRoom(map);
+
+  ohm::RangeSensor sensor;
+  sensor.model = ohm::RangeSensorModel::kSpherical;
+  sensor.width = 360;  // NOLINT(readability-magic-numbers)
+  sensor.height = 16;  // NOLINT(readability-magic-numbers)
+  sensor.min_elevation = glm::radians(-10.0);
+  sensor.max_elevation = glm::radians(10.0);
+  sensor.max_range = 10.0;
+
+  // Offset the sensor within the room. The rays must be corrected for the offset.
+  const glm::dvec3 sensor_position(0.3, -0.2, 0.1);
+  glm::dmat4 sensor_to_map(1.0);
+  sensor_to_map[3] = glm::dvec4(sensor_position, 1.0);
+
+  ohm::RangeImageGpu range_image(ohm::gpuDevice());
+  range_image.setSensor(sensor);
+  ASSERT_TRUE(range_image.render(map, sensor_to_map));
+
+  const double azimuth_step = (sensor.max_azimuth - sensor.min_azimuth) / sensor.width;
+  const double elevation_step = (sensor.max_elevation - sensor.min_elevation) / sensor.height;
+  for (unsigned v = 0; v < sensor.height; ++v)
+  {
+    for (unsigned u = 0; u < sensor.width; ++u)
+    {
+      const double azimuth = sensor.min_azimuth + (u + 0.5) * azimuth_step;
+      const double elevation = sensor.max_elevation - (v + 0.5) * elevation_step;
+      const glm::dvec3 dir(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth),
+                           std::sin(elevation));
+      // Range to the inner face of the first wall hit.
+      double expected = sensor.max_range;
+      for (int axis = 0; axis < 2; ++axis)
+      {
+        if (dir[axis] != 0)
+        {
+          const double face = (dir[axis] > 0) ? 4.9 : -4.9;
+          expected = std::min(expected, (face - sensor_position[axis]) / dir[axis]);
+        }
+      }
+      EXPECT_NEAR(range_image.ranges()[v * sensor.width + u], expected, 2e-3) << u << "," << v;
+    }
+  }
+}
+}  // namespace rangeimagetests
@@ -11,10 +11,15 @@
 #include <ohm/RayMapperOccupancy.h>
 #include <ohm/VoxelOccupancy.h>
 
+#include <gputil/gpuBuffer.h>
+
 #include <logutil/LogUtil.h>
 #include <ohmutil/GlmStream.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <random>
@@ -253,4 +258,142 @@ TEST(RaysQuery, CpuVsGpu)
     }
   }
 }
+
+TEST(RaysQuery, GpuReduce)
+{
+  // Validate GPU reductions for groups of rays against reducing the per ray GPU results on CPU, both with readback and
+  // with results left in a caller supplied GPU buffer.
+  const double base_scale = 10.0;
+  const double resolution = 0.1;
+  const unsigned ray_count = 2000;
+  const unsigned group_size = 64;
+  const unsigned group_count = (ray_count + group_size - 1) / group_size;
+
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-base_scale, base_scale);
+  std::vector<glm::dvec3> rays;
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  ohm::OccupancyMap map(resolution, ohm::MapFlag::kNone);
+  ohm::RayMapperOccupancy mapper(&map);
+  // Map half the rays so the queries see a mix of free, occupied and unobserved space.
+  mapper.integrateRays(rays.data(), rays.size() / 2);
+
+  {
+    // Scoped to ensure the query releases GPU resources before the occupancy map.
+    ohm::RaysQueryGpu query;
+    query.setMap(&map);
+    query.setRays(rays);
+
+    // Per ray results to reduce on CPU.
+    ASSERT_TRUE(query.execute());
+    ASSERT_EQ(query.numberOfResults(), ray_count);
+    std::vector<RaysQueryReduceResult> expected(group_count, RaysQueryReduceResult{});
+    for (unsigned i = 0; i < ray_count; ++i)
+    {
+      RaysQueryReduceResult &reduction = expected[i / group_size];
+      reduction.unobserved_volume += float(query.unobservedVolumes()[i]);
+      reduction.min_range =
+        (i % group_size == 0) ? float(query.ranges()[i]) : std::min(reduction.min_range, float(query.ranges()[i]));
+      reduction.occupied_count += (query.terminalOccupancyTypes()[i] == ohm::kOccupied) ? 1 : 0;
+    }
+
+    const auto compare_reductions = [&expected](const RaysQueryReduceResult *reductions) {
+      for (unsigned i = 0; i < group_count; ++i)
+      {
+        EXPECT_NEAR(reductions[i].unobserved_volume, expected[i].unobserved_volume,
+                    1e-3f * std::max(1.0f, expected[i].unobserved_volume))
+          << "[" << i << "]";
+        EXPECT_NEAR(reductions[i].min_range, expected[i].min_range, 1e-5f) << "[" << i << "]";
+        EXPECT_EQ(reductions[i].occupied_count, expected[i].occupied_count) << "[" << i << "]";
+      }
+    };
+
+    // Reduce with readback.
+    query.setReduction(ohm::RaysQueryGpu::kReduceAll, group_size);
+    query.reset(false);
+    ASSERT_TRUE(query.execute());
+    EXPECT_EQ(query.numberOfResults(), 0u);
+    size_t reduction_count = 0;
+    const RaysQueryReduceResult *reductions = query.reductions(&reduction_count);
+    ASSERT_EQ(reduction_count, group_count);
+    compare_reductions(reductions);
+
+    // Reduce into our own buffer.
+    gputil::Buffer output;
+    query.setOutputBuffer(&output);
+    query.reset(false);
+    ASSERT_TRUE(query.execute());
+    query.reductions(&reduction_count);
+    EXPECT_EQ(reduction_count, 0u);
+    ASSERT_TRUE(output.isValid());
+    ASSERT_GE(output.elementCount<RaysQueryReduceResult>(), group_count);
+    std::vector<RaysQueryReduceResult> gpu_reductions(group_count);
+    output.readElements(gpu_reductions.data(), group_count);
+    compare_reductions(gpu_reductions.data());
+
+    query.setOutputBuffer(nullptr);
+  }
+}
+
+TEST(RaysQuery, GpuAsync)
+{
+  // The completion function of an asynchronous GPU query fires on the GPU results event, without a wait() call.
+  const double base_scale = 10.0;
+  const double resolution = 0.1;
+  const unsigned ray_count = 2000;
+
+  std::mt19937 rand_engine;
+  std::uniform_real_distribution<double> rand(-base_scale, base_scale);
+  std::vector<glm::dvec3> rays;
+  while (rays.size() < ray_count * 2)
+  {
+    rays.emplace_back(glm::dvec3(0.0));
+    rays.emplace_back(glm::dvec3(rand(rand_engine), rand(rand_engine), rand(rand_engine)));
+  }
+
+  ohm::OccupancyMap map(resolution, ohm::MapFlag::kNone);
+  ohm::RayMapperOccupancy mapper(&map);
+  mapper.integrateRays(rays.data(), rays.size() / 2);
+
+  {
+    // Scoped to ensure the queries release GPU resources before the occupancy map.
+    ohm::RaysQueryGpu reference;
+    reference.setMap(&map);
+    reference.setRays(rays);
+    ASSERT_TRUE(reference.execute());
+
+    ohm::RaysQueryGpu query;
+    query.setMap(&map);
+    query.setRays(rays);
+
+    std::promise<bool> completed;
+    std::future<bool> completed_future = completed.get_future();
+    std::atomic_int callback_count{ 0 };
+    std::atomic_size_t callback_results{ 0 };
+    ASSERT_TRUE(query.executeAsync([&](ohm::Query &completed_query, bool ok) {
+      EXPECT_EQ(&completed_query, &query);
+      callback_results = completed_query.numberOfResults();
+      ++callback_count;
+      completed.set_value(ok);
+    }));
+
+    // Only wait() once the completion function has fired.
+    ASSERT_EQ(completed_future.wait_for(std::chrono::seconds(30)), std::future_status::ready);
+    EXPECT_TRUE(completed_future.get());
+    EXPECT_TRUE(query.wait());
+    EXPECT_EQ(callback_count, 1);
+    EXPECT_EQ(callback_results, reference.numberOfResults());
+    ASSERT_EQ(query.numberOfResults(), reference.numberOfResults());
+    for (size_t i = 0; i < query.numberOfResults(); ++i)
+    {
+      EXPECT_EQ(query.ranges()[i], reference.ranges()[i]) << "[" << i << "]";
+      EXPECT_EQ(query.terminalOccupancyTypes()[i], reference.terminalOccupancyTypes()[i]) << "[" << i << "]";
+    }
+  }
+}
 }  // namespace raysquerytests
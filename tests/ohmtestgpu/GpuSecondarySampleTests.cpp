@@ -0,0 +1,99 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include <gtest/gtest.h>
+
+#include <ohm/DefaultLayer.h>
+#include <ohm/Key.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperSecondarySample.h>
+#include <ohm/Voxel.h>
+#include <ohm/VoxelSecondarySample.h>
+
+#include <ohmgpu/GpuMap.h>
+#include <ohmgpu/GpuSecondarySampleMap.h>
+
+#include <glm/vec3.hpp>
+
+#include <random>
+#include <set>
+#include <vector>
+
+namespace secondarysample
+{
+TEST(SecondarySample, GpuVsCpu)
+{
+  // Compare GPU and CPU secondary sample accumulation. The rays run from primary samples to secondary samples, with
+  // many secondary samples falling in the same voxels.
+  const double resolution = 0.1;
+  const unsigned ray_count = 2000u;
+  std::vector<glm::dvec3> rays;
+  uint32_t seed = 1153297050u;
+  std::default_random_engine rng(seed);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::uniform_real_distribution<double> range_rand(0.2, 2.0);
+  std::uniform_int_distribution<int> voxel_rand(-4, 4);
+
+  rays.reserve(2 * ray_count);
+  for (unsigned r = 0; r < ray_count; ++r)
+  {
+    // Secondary sample at a voxel centre from a small set, with the primary sample a random range away.
+    const glm::dvec3 secondary(voxel_rand(rng) * resolution, voxel_rand(rng) * resolution, 0.0);
+    glm::dvec3 dir(uniform(rng), uniform(rng), uniform(rng));
+    dir = (glm::length(dir) > 1e-3) ? glm::normalize(dir) : glm::dvec3(1, 0, 0);
+    rays.emplace_back(secondary + range_rand(rng) * dir);
+    rays.emplace_back(secondary);
+  }
+
+  ohm::OccupancyMap cpu_map(resolution, ohm::MapFlag::kSecondarySample);
+  ohm::OccupancyMap gpu_map(resolution, ohm::MapFlag::kSecondarySample);
+  // Offset the maps so that (0, 0, 0) is a voxel centre.
+  cpu_map.setOrigin(glm::dvec3(-0.5 * resolution));
+  gpu_map.setOrigin(glm::dvec3(-0.5 * resolution));
+
+  ohm::RayMapperSecondarySample cpu_mapper(&cpu_map);
+  ASSERT_TRUE(cpu_mapper.valid());
+  ohm::GpuSecondarySampleMap gpu_mapper(&gpu_map, true);
+  ASSERT_TRUE(gpu_mapper.valid());
+
+  // Integrate in several batches to exercise the GPU buffer pipeline.
+  const unsigned batch_ray_count = 500u;
+  for (unsigned r = 0; r < ray_count; r += batch_ray_count)
+  {
+    cpu_mapper.integrateRays(&rays[r * 2], 2 * batch_ray_count);
+    gpu_mapper.integrateRays(&rays[r * 2], 2 * batch_ray_count);
+  }
+  gpu_mapper.syncVoxels();
+
+  ohm::Voxel<const ohm::VoxelSecondarySample> cpu_voxel(
+    &cpu_map, cpu_map.layout().layerIndex(ohm::default_layer::secondarySamplesLayerName()));
+  ohm::Voxel<const ohm::VoxelSecondarySample> gpu_voxel(
+    &gpu_map, gpu_map.layout().layerIndex(ohm::default_layer::secondarySamplesLayerName()));
+  ASSERT_TRUE(cpu_voxel.isLayerValid());
+  ASSERT_TRUE(gpu_voxel.isLayerValid());
+
+  std::set<ohm::Key> keys;
+  for (size_t i = 1; i < rays.size(); i += 2)
+  {
+    keys.insert(cpu_map.voxelKey(rays[i]));
+  }
+
+  for (const ohm::Key &key : keys)
+  {
+    cpu_voxel.setKey(key);
+    gpu_voxel.setKey(key);
+    ASSERT_TRUE(cpu_voxel.isValid());
+    ASSERT_TRUE(gpu_voxel.isValid());
+    const ohm::VoxelSecondarySample cpu_data = cpu_voxel.data();
+    const ohm::VoxelSecondarySample gpu_data = gpu_voxel.data();
+
+    // The GPU update is single precision and iterates samples in a different order, so the quantised mean may differ
+    // slightly.
+    EXPECT_EQ(gpu_data.count, cpu_data.count) << key;
+    EXPECT_NEAR(ohm::secondarySampleRangeMean(gpu_data), ohm::secondarySampleRangeMean(cpu_data), 2e-2) << key;
+    EXPECT_NEAR(ohm::secondarySampleRangeStdDev(gpu_data), ohm::secondarySampleRangeStdDev(cpu_data), 2e-2) << key;
+  }
+}
+}  // namespace secondarysample
@@ -11,8 +11,12 @@
 #include <ohm/RayMapperTsdf.h>
 #include <ohm/VoxelData.h>
 
+#include <ohmgpu/GpuMap.h>
+#include <ohmgpu/GpuOccupancyTsdfMap.h>
 #include <ohmgpu/GpuTsdfMap.h>
 #include <ohmgpu/LineKeysQueryGpu.h>
+#include <ohmgpu/OhmGpu.h>
+#include <ohmgpu/TsdfMeshGpu.h>
 
 namespace tsdf
 {
@@ -155,4 +159,133 @@ TEST(Tsdf, Truncation)
     }
   }
 }
+
+TEST(Tsdf, FusedOccupancy)
+{
+  // Validate the fused occupancy and TSDF mapper against running the occupancy and TSDF mappers separately.
+  const double resolution = 0.1;
+  const glm::u8vec3 region_size(16);
+  const double plane_x = 1.05;
+
+  std::vector<glm::dvec3> rays;
+  for (double z = -0.8; z <= 0.8; z += 0.5 * resolution)
+  {
+    for (double y = -0.8; y <= 0.8; y += 0.5 * resolution)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(plane_x, y, z));
+    }
+  }
+
+  ohm::TsdfOptions tsdf_options;
+  tsdf_options.default_truncation_distance = float(4 * resolution);
+
+  ohm::OccupancyMap occupancy_map(resolution, region_size);
+  ohm::OccupancyMap tsdf_map(resolution, region_size, ohm::MapFlag::kTsdf);
+  ohm::OccupancyMap fused_map(resolution, region_size, ohm::MapFlag::kTsdf);
+
+  {
+    ohm::GpuMap occupancy_mapper(&occupancy_map);
+    occupancy_mapper.integrateRays(rays.data(), rays.size(), nullptr, nullptr, 0);
+    occupancy_mapper.syncVoxels();
+
+    ohm::GpuTsdfMap tsdf_mapper(&tsdf_map);
+    tsdf_mapper.setTsdfOptions(tsdf_options);
+    tsdf_mapper.integrateRays(rays.data(), rays.size(), nullptr, nullptr, 0);
+    tsdf_mapper.syncVoxels();
+
+    ohm::GpuOccupancyTsdfMap fused_mapper(&fused_map);
+    fused_mapper.setTsdfOptions(tsdf_options);
+    fused_mapper.integrateRays(rays.data(), rays.size(), nullptr, nullptr, 0);
+    fused_mapper.syncVoxels();
+  }
+
+  ohm::Voxel<const float> ref_occupancy(&occupancy_map, occupancy_map.layout().occupancyLayer());
+  ohm::Voxel<const float> fused_occupancy(&fused_map, fused_map.layout().occupancyLayer());
+  ASSERT_TRUE(ref_occupancy.isLayerValid());
+  ASSERT_TRUE(fused_occupancy.isLayerValid());
+
+  unsigned occupancy_count = 0;
+  for (auto iter = occupancy_map.begin(); iter != occupancy_map.end(); ++iter)
+  {
+    ohm::setVoxelKey(iter, ref_occupancy);
+    if (ohm::isUnobservedOrNull(ref_occupancy))
+    {
+      continue;
+    }
+    ++occupancy_count;
+    ohm::setVoxelKey(*iter, fused_occupancy);
+    ASSERT_TRUE(fused_occupancy.isValid());
+    EXPECT_NEAR(fused_occupancy.data(), ref_occupancy.data(), 1e-4f);
+  }
+  EXPECT_GT(occupancy_count, 0u);
+
+  ohm::Voxel<const ohm::VoxelTsdf> ref_tsdf(&tsdf_map,
+                                            tsdf_map.layout().layerIndex(ohm::default_layer::tsdfLayerName()));
+  ohm::Voxel<const ohm::VoxelTsdf> fused_tsdf(&fused_map,
+                                              fused_map.layout().layerIndex(ohm::default_layer::tsdfLayerName()));
+  ASSERT_TRUE(ref_tsdf.isLayerValid());
+  ASSERT_TRUE(fused_tsdf.isLayerValid());
+
+  unsigned tsdf_count = 0;
+  for (auto iter = tsdf_map.begin(); iter != tsdf_map.end(); ++iter)
+  {
+    ohm::setVoxelKey(iter, ref_tsdf);
+    const ohm::VoxelTsdf expect = ref_tsdf.data();
+    if (expect.weight <= 0)
+    {
+      continue;
+    }
+    ++tsdf_count;
+    ohm::setVoxelKey(*iter, fused_tsdf);
+    ASSERT_TRUE(fused_tsdf.isValid());
+    const ohm::VoxelTsdf actual = fused_tsdf.data();
+    EXPECT_NEAR(actual.weight, expect.weight, 1e-4f);
+    EXPECT_NEAR(actual.distance, expect.distance, 1e-4f);
+  }
+  EXPECT_GT(tsdf_count, 0u);
+}
+
+TEST(Tsdf, MeshGpu)
+{
+  const double resolution = 0.1;
+  const glm::u8vec3 region_size(16);
+  const double plane_x = 1.05;
+
+  // Build rays from the origin to a wall at plane_x, spanning several regions.
+  std::vector<glm::dvec3> rays;
+  for (double z = -0.8; z <= 0.8; z += 0.5 * resolution)
+  {
+    for (double y = -0.8; y <= 0.8; y += 0.5 * resolution)
+    {
+      rays.emplace_back(glm::dvec3(0.0));
+      rays.emplace_back(glm::dvec3(plane_x, y, z));
+    }
+  }
+
+  ohm::OccupancyMap map(resolution, region_size, ohm::MapFlag::kTsdf);
+  ohm::GpuTsdfMap tsdf_mapper(&map);
+  tsdf_mapper.setDefaultTruncationDistance(float(4 * resolution));
+  tsdf_mapper.integrateRays(rays.data(), rays.size(), nullptr, nullptr, 0);
+  tsdf_mapper.syncVoxels();
+
+  ohm::TsdfMeshGpu mesher(ohm::gpuDevice());
+  const int meshed = mesher.update(map);
+  ASSERT_GT(meshed, 0);
+  EXPECT_GT(mesher.triangleCount(), 0u);
+
+  // No changes: nothing to re-mesh.
+  EXPECT_EQ(mesher.update(map), 0);
+
+  std::vector<glm::dvec3> vertices;
+  std::vector<unsigned> indices;
+  mesher.exportMesh(vertices, indices);
+  ASSERT_EQ(indices.size(), mesher.triangleCount() * 3u);
+
+  // The surface should lie on the wall. Allow for voxel quantisation and the truncated distance fall off.
+  for (const auto &vertex : vertices)
+  {
+    EXPECT_NEAR(vertex.x, plane_x, 2 * resolution);
+  }
+}
 }  // namespace tsdf
@@ -5,12 +5,17 @@
 // Author: Kazys Stepanas
 #include <gtest/gtest.h>
 
+#include "ohmtestcommon/OhmTestUtil.h"
+
 #include <ohmheightmap/Heightmap.h>
+#include <ohmheightmap/HeightmapGrid.h>
 #include <ohmheightmap/HeightmapMesh.h>
+#include <ohmheightmap/HeightmapSerialise.h>
 #include <ohmheightmap/HeightmapVoxel.h>
 #include <ohmheightmap/TriangleNeighbours.h>
 
 #include <ohm/KeyRange.h>
+#include <ohm/MapChunk.h>
 #include <ohm/MapLayer.h>
 #include <ohm/MapLayout.h>
 #include <ohm/MapSerialise.h>
@@ -1407,3 +1412,591 @@ TEST(Heightmap, VirtualSurfaceLayered)
   // EXPECT_TRUE(validation_info.surface.empty());
   // EXPECT_TRUE(validation_info.virtual_surface.empty());
 }
+
+
+/// Validate that @p test exactly matches the @p reference heightmap content.
+/// @param reference The reference heightmap.
+/// @param test The heightmap to validate.
+/// @param compare_region_count True to also require the same number of heightmap regions. Clear when @p test may
+///   retain regions the @p reference does not generate, such as after an incremental update.
+void compareHeightmaps(const ohm::Heightmap &reference, const ohm::Heightmap &test, bool compare_region_count = true)
+{
+  const ohm::OccupancyMap &ref_map = reference.heightmap();
+  const ohm::OccupancyMap &test_map = test.heightmap();
+  ohm::Voxel<const float> ref_occupancy(&ref_map, ref_map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::HeightmapVoxel> ref_voxel(&ref_map, reference.heightmapVoxelLayer());
+  ohm::Voxel<const float> test_occupancy(&test_map, test_map.layout().occupancyLayer());
+  ohm::Voxel<const ohm::HeightmapVoxel> test_voxel(&test_map, test.heightmapVoxelLayer());
+  ASSERT_TRUE(ref_voxel.isLayerValid());
+  ASSERT_TRUE(test_voxel.isLayerValid());
+
+  size_t voxel_count = 0;
+  for (auto iter = ref_map.begin(); iter != ref_map.end(); ++iter)
+  {
+    // Note: the maps differ so we cannot chain the keys across maps.
+    ohm::setVoxelKey(iter, ref_occupancy, ref_voxel);
+    ohm::setVoxelKey(*iter, test_occupancy, test_voxel);
+    ASSERT_TRUE(test_occupancy.isValid()) << iter.key();
+    EXPECT_EQ(test_occupancy.data(), ref_occupancy.data()) << iter.key();
+    const ohm::HeightmapVoxel ref = ref_voxel.data();
+    const ohm::HeightmapVoxel voxel = test_voxel.data();
+    EXPECT_EQ(voxel.height, ref.height) << iter.key();
+    EXPECT_EQ(voxel.clearance, ref.clearance) << iter.key();
+    EXPECT_EQ(voxel.layer, ref.layer) << iter.key();
+    ++voxel_count;
+  }
+  EXPECT_GT(voxel_count, 0u);
+  if (compare_region_count)
+  {
+    EXPECT_EQ(test_map.regionCount(), ref_map.regionCount());
+  }
+
+  // Validate there are no extra voxels in the test map.
+  for (auto iter = test_map.begin(); iter != test_map.end(); ++iter)
+  {
+    ref_occupancy.setKey(*iter);
+    test_occupancy.setKey(iter);
+    if (test_occupancy.data() != ohm::unobservedOccupancyValue())
+    {
+      EXPECT_TRUE(ref_occupancy.isValid()) << iter.key();
+    }
+  }
+}
+
+
+TEST(Heightmap, Threads)
+{
+  // Multi-threaded generation must exactly match single threaded generation.
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  ohm::OccupancyMap map(0.1);
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const std::vector<ohm::HeightmapMode> modes = { ohm::HeightmapMode::kPlanar, ohm::HeightmapMode::kSimpleFill,
+                                                  ohm::HeightmapMode::kLayeredFillUnordered,
+                                                  ohm::HeightmapMode::kLayeredFill };
+  for (const auto mode : modes)
+  {
+    std::vector<std::unique_ptr<ohm::Heightmap>> heightmaps;
+    for (unsigned thread_count : { 1u, 4u })
+    {
+      heightmaps.emplace_back(std::make_unique<ohm::Heightmap>(map.resolution(), 2 * map.resolution()));
+      ohm::Heightmap &heightmap = *heightmaps.back();
+      heightmap.setOccupancyMap(&map);
+      heightmap.heightmap().setOrigin(map.origin());
+      heightmap.setMode(mode);
+      heightmap.setGenerateVirtualSurface(true);
+#ifdef OHM_FEATURE_THREADS
+      EXPECT_TRUE(heightmap.setThreadCount(thread_count));
+#else   // OHM_FEATURE_THREADS
+      EXPECT_EQ(heightmap.setThreadCount(thread_count), thread_count == 1);
+#endif  // OHM_FEATURE_THREADS
+      ASSERT_TRUE(heightmap.buildHeightmap(glm::dvec3(0, 0, 0.5 * params.platform_height)));
+    }
+
+    SCOPED_TRACE(int(mode));
+
+    compareHeightmaps(*heightmaps[0], *heightmaps[1]);
+  }
+}
+
+
+TEST(Heightmap, ConcurrentFill)
+{
+  // The concurrent fill visits keys in a non-deterministic order, so we cannot compare against the serial fill. Instead
+  // we validate each heightmap voxel against the source map.
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  ohm::OccupancyMap map(0.1);
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  for (const auto mode : { ohm::HeightmapMode::kLayeredFillUnordered, ohm::HeightmapMode::kLayeredFill })
+  {
+    SCOPED_TRACE(int(mode));
+    ohm::Heightmap heightmap(map.resolution(), 2 * map.resolution());
+    heightmap.setOccupancyMap(&map);
+    heightmap.heightmap().setOrigin(map.origin());
+    heightmap.setMode(mode);
+    heightmap.setGenerateVirtualSurface(true);
+    heightmap.setThreadCount(4);
+    heightmap.setConcurrentFill(true);
+    EXPECT_TRUE(heightmap.concurrentFill());
+    ASSERT_TRUE(heightmap.buildHeightmap(glm::dvec3(0, 0, 0.5 * params.platform_height)));
+
+    const ohm::OccupancyMap &heightmap_map = heightmap.heightmap();
+    ohm::Voxel<const float> src_occupancy(&map, map.layout().occupancyLayer());
+    unsigned surface_count = 0;
+    for (auto iter = heightmap_map.begin(); iter != heightmap_map.end(); ++iter)
+    {
+      glm::dvec3 pos{};
+      const HeightmapVoxelType voxel_type = heightmap.getHeightmapVoxelInfo(*iter, &pos);
+      if (voxel_type == HeightmapVoxelType::kSurface || voxel_type == HeightmapVoxelType::kVirtualSurface)
+      {
+        src_occupancy.setKey(map.voxelKey(pos));
+        ASSERT_TRUE(src_occupancy.isValid());
+        EXPECT_EQ(int(ohm::occupancyType(src_occupancy)),
+                  int((voxel_type == HeightmapVoxelType::kSurface) ? ohm::kOccupied : ohm::kFree));
+        ++surface_count;
+      }
+    }
+    EXPECT_GT(surface_count, 0u);
+  }
+}
+
+
+TEST(Heightmap, Incremental)
+{
+  // Incremental updates must match a full rebuild.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const glm::dvec3 reference_pos(0, 0, 0.5 * params.platform_height);
+  const std::vector<ohm::HeightmapMode> modes = { ohm::HeightmapMode::kPlanar, ohm::HeightmapMode::kSimpleFill,
+                                                  ohm::HeightmapMode::kLayeredFill };
+  // Heightmap resolutions to test. The coarser resolution does not align with the source regions.
+  const std::vector<double> resolutions = { map.resolution(), 0.25 };
+  // Use small heightmap regions so we can detect which regions are regenerated.
+  const unsigned region_size = 16;
+  int obstacle_index = 0;
+  for (const auto mode : modes)
+  {
+    for (const double resolution : resolutions)
+    {
+      SCOPED_TRACE(std::to_string(int(mode)) + " " + std::to_string(resolution));
+      ohm::Heightmap incremental(resolution, 2 * map.resolution(), ohm::UpAxis::kZ, region_size);
+      incremental.setOccupancyMap(&map);
+      incremental.heightmap().setOrigin(map.origin());
+      incremental.setMode(mode);
+      incremental.setGenerateVirtualSurface(true);
+      // The first call makes a full build.
+      ASSERT_TRUE(incremental.updateHeightmap(reference_pos));
+
+      // Find a heightmap region far from the changes below to check which regions are regenerated.
+      const glm::dvec3 far_pos(-params.map_half_extents + 0.5, -params.map_half_extents + 0.5, 0);
+      const ohm::MapChunk *far_chunk = incremental.heightmap().region(incremental.heightmap().regionKey(far_pos));
+      ASSERT_NE(far_chunk, nullptr);
+      uint64_t far_stamp = far_chunk->dirty_stamp;
+
+      // No changes: nothing regenerated.
+      ASSERT_TRUE(incremental.updateHeightmap(reference_pos));
+      EXPECT_EQ(far_chunk->dirty_stamp, far_stamp);
+
+      // Add an obstacle. Use a different location each time so we keep changing the map.
+      const glm::dvec3 obstacle_pos(1.0 + 0.3 * obstacle_index, 3.5, 0.5);  // NOLINT(readability-magic-numbers)
+      ++obstacle_index;
+      for (int z = 0; z < 5; ++z)
+      {
+        ohm::integrateHit(map, map.voxelKey(obstacle_pos + glm::dvec3(0, 0, z * map.resolution())));
+      }
+      ASSERT_TRUE(incremental.updateHeightmap(reference_pos));
+      if (mode == ohm::HeightmapMode::kPlanar)
+      {
+        EXPECT_EQ(far_chunk->dirty_stamp, far_stamp);
+      }
+
+      ohm::Heightmap full(resolution, 2 * map.resolution(), ohm::UpAxis::kZ, region_size);
+      full.setOccupancyMap(&map);
+      full.heightmap().setOrigin(map.origin());
+      full.setMode(mode);
+      full.setGenerateVirtualSurface(true);
+      ASSERT_TRUE(full.buildHeightmap(reference_pos));
+      compareHeightmaps(full, incremental, false);
+
+      // Changing parameters forces a rebuild.
+      far_chunk = incremental.heightmap().region(incremental.heightmap().regionKey(far_pos));
+      ASSERT_NE(far_chunk, nullptr);
+      far_stamp = far_chunk->dirty_stamp;
+      incremental.setCeiling(1.0);
+      full.setCeiling(1.0);
+      ASSERT_TRUE(incremental.updateHeightmap(reference_pos));
+      ASSERT_TRUE(full.buildHeightmap(reference_pos));
+      far_chunk = incremental.heightmap().region(incremental.heightmap().regionKey(far_pos));
+      ASSERT_NE(far_chunk, nullptr);
+      EXPECT_GT(far_chunk->dirty_stamp, far_stamp);
+      compareHeightmaps(full, incremental, false);
+    }
+  }
+}
+
+
+TEST(Heightmap, MeshTiles)
+{
+  // Mesh tiles must cover the full mesh vertices and only regenerate tiles for modified heightmap regions.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const glm::dvec3 reference_pos(0, 0, 0.5 * params.platform_height);
+  const unsigned region_size = 16;
+  ohm::Heightmap heightmap(map.resolution(), 2 * map.resolution(), ohm::UpAxis::kZ, region_size);
+  heightmap.setOccupancyMap(&map);
+  heightmap.heightmap().setOrigin(map.origin());
+  heightmap.setGenerateVirtualSurface(true);
+  ASSERT_TRUE(heightmap.updateHeightmap(reference_pos));
+
+  ohm::HeightmapMesh mesh;
+  ASSERT_TRUE(mesh.buildMesh(heightmap));
+
+  // First build generates all tiles.
+  const size_t tile_count = mesh.buildTiles(heightmap);
+  ASSERT_GT(tile_count, 1u);
+  ASSERT_EQ(tile_count, mesh.tileCount());
+
+  // Validate the tiles and collect the unique vertices. The planar heightmap has one vertex per voxel.
+  const ohm::OccupancyMap &heightmap_map = heightmap.heightmap();
+  std::unordered_set<ohm::Key, ohm::Key::Hash> vertex_keys;
+  size_t triangle_count = 0;
+  for (size_t i = 0; i < mesh.tileCount(); ++i)
+  {
+    const ohm::HeightmapMeshTile &tile = mesh.tiles()[i];
+    EXPECT_TRUE(tile.dirty);
+    EXPECT_EQ(tile.region_key.z, 0);
+    EXPECT_EQ(tile.vertices.size(), tile.vertex_normals.size());
+    ASSERT_EQ(tile.indices.size() % 3, 0u);
+    for (const unsigned index : tile.indices)
+    {
+      ASSERT_LT(index, tile.vertices.size());
+    }
+    for (const glm::vec3 &vertex : tile.vertices)
+    {
+      glm::dvec3 pos = tile.origin + glm::dvec3(vertex);
+      pos.z = 0;
+      vertex_keys.emplace(heightmap_map.voxelKey(pos));
+    }
+    triangle_count += tile.indices.size() / 3;
+  }
+  EXPECT_EQ(vertex_keys.size(), mesh.vertexCount());
+  EXPECT_GT(triangle_count, 0u);
+
+  // No changes: no tiles regenerated.
+  EXPECT_EQ(mesh.buildTiles(heightmap), 0u);
+  for (size_t i = 0; i < mesh.tileCount(); ++i)
+  {
+    EXPECT_FALSE(mesh.tiles()[i].dirty);
+  }
+
+  // Add an obstacle and update the heightmap. Only some tiles are regenerated.
+  const glm::dvec3 obstacle_pos(1.0, 3.5, 0.5);  // NOLINT(readability-magic-numbers)
+  for (int z = 0; z < 5; ++z)
+  {
+    ohm::integrateHit(map, map.voxelKey(obstacle_pos + glm::dvec3(0, 0, z * map.resolution())));
+  }
+  ASSERT_TRUE(heightmap.updateHeightmap(reference_pos));
+  const size_t rebuilt_count = mesh.buildTiles(heightmap);
+  EXPECT_GT(rebuilt_count, 0u);
+  EXPECT_LT(rebuilt_count, mesh.tileCount());
+
+  // Clearing the tiles regenerates everything.
+  mesh.clearTiles();
+  EXPECT_EQ(mesh.tileCount(), 0u);
+  EXPECT_EQ(mesh.buildTiles(heightmap), mesh.tileCount());
+}
+
+
+TEST(Heightmap, Grid)
+{
+  // The query grid must match the heightmap voxels and only re-extract blocks for modified heightmap regions.
+  ohm::OccupancyMap map(0.1, glm::u8vec3(16));
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const glm::dvec3 reference_pos(0, 0, 0.5 * params.platform_height);
+  const unsigned region_size = 16;
+  ohm::Heightmap heightmap(map.resolution(), 2 * map.resolution(), ohm::UpAxis::kZ, region_size);
+  heightmap.setOccupancyMap(&map);
+  heightmap.heightmap().setOrigin(map.origin());
+  heightmap.setGenerateVirtualSurface(true);
+  ASSERT_TRUE(heightmap.updateHeightmap(reference_pos));
+
+  ohm::HeightmapGrid grid;
+  const size_t block_count = grid.update(heightmap);
+  ASSERT_GT(block_count, 1u);
+  ASSERT_EQ(block_count, grid.blocks().size());
+
+  // Validate every known heightmap voxel against the grid.
+  const ohm::OccupancyMap &heightmap_map = heightmap.heightmap();
+  std::vector<const ohm::MapChunk *> chunks;
+  heightmap_map.enumerateRegions(chunks);
+  size_t voxel_count = 0;
+  for (const ohm::MapChunk *chunk : chunks)
+  {
+    for (uint8_t y = 0; y < region_size; ++y)
+    {
+      for (uint8_t x = 0; x < region_size; ++x)
+      {
+        const ohm::Key key(chunk->region.coord, x, y, 0);
+        glm::dvec3 pos;
+        ohm::HeightmapVoxel voxel_info{};
+        const ohm::HeightmapVoxelType voxel_type = heightmap.getHeightmapVoxelInfo(key, &pos, &voxel_info);
+        if (voxel_type == ohm::HeightmapVoxelType::kUnknown)
+        {
+          continue;
+        }
+
+        ++voxel_count;
+        const glm::ivec2 cell = grid.cellCoord(heightmap_map.voxelCentreGlobal(key));
+        unsigned begin = 0;
+        unsigned end = 0;
+        const ohm::HeightmapGridBlock *block = grid.cellLayers(cell, &begin, &end);
+        ASSERT_NE(block, nullptr);
+        ASSERT_LT(begin, end);
+        EXPECT_EQ(block->type[begin], voxel_type);
+        EXPECT_NEAR(block->height[begin], pos.z - heightmap_map.origin().z, 1e-4);
+        EXPECT_NEAR(block->clearance[begin], voxel_info.clearance, 1e-4);
+      }
+    }
+  }
+  EXPECT_GT(voxel_count, 0u);
+
+  // Cells outside the heightmap have no block.
+  glm::ivec2 min_block;
+  glm::ivec2 max_block;
+  ASSERT_TRUE(grid.blockRange(&min_block, &max_block));
+  EXPECT_EQ(grid.block((max_block + glm::ivec2(1)) * grid.blockDimensions()), nullptr);
+
+  // No changes: no blocks re-extracted.
+  EXPECT_EQ(grid.update(heightmap), 0u);
+
+  // Add an obstacle and update the heightmap. Only some blocks are re-extracted.
+  const glm::dvec3 obstacle_pos(1.0, 3.5, 0.5);  // NOLINT(readability-magic-numbers)
+  for (int z = 0; z < 5; ++z)
+  {
+    ohm::integrateHit(map, map.voxelKey(obstacle_pos + glm::dvec3(0, 0, z * map.resolution())));
+  }
+  ASSERT_TRUE(heightmap.updateHeightmap(reference_pos));
+  const size_t extracted_count = grid.update(heightmap);
+  EXPECT_GT(extracted_count, 0u);
+  EXPECT_LT(extracted_count, grid.blocks().size());
+
+  // Clearing the grid re-extracts everything.
+  grid.clear();
+  EXPECT_TRUE(grid.blocks().empty());
+  EXPECT_EQ(grid.update(heightmap), grid.blocks().size());
+}
+
+
+TEST(Heightmap, Tiled)
+{
+  // Planar tiles must match the corresponding section of a full heightmap and cover it exactly.
+  const ohmtestutil::WorkerThreadScope worker_threads;
+  ohm::OccupancyMap map(0.1);
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const glm::dvec3 reference_pos(0, 0, 0.5 * params.platform_height);
+  // Use small heightmap regions to generate a number of tiles.
+  const unsigned region_size = 16;
+  ohm::Heightmap full(map.resolution(), 2 * map.resolution(), ohm::UpAxis::kZ, region_size);
+  full.setOccupancyMap(&map);
+  full.heightmap().setOrigin(map.origin());
+  full.setGenerateVirtualSurface(true);
+  ASSERT_TRUE(full.buildHeightmap(reference_pos));
+
+  const ohm::OccupancyMap &full_map = full.heightmap();
+  size_t full_voxel_count = 0;
+  ohm::Voxel<const float> full_occupancy(&full_map, full_map.layout().occupancyLayer());
+  for (auto iter = full_map.begin(); iter != full_map.end(); ++iter)
+  {
+    full_occupancy.setKey(iter);
+    full_voxel_count += full_occupancy.data() != ohm::unobservedOccupancyValue();
+  }
+  full_occupancy.reset();
+  ASSERT_GT(full_voxel_count, 0u);
+
+  for (unsigned thread_count : { 1u, 4u })
+  {
+    SCOPED_TRACE(thread_count);
+    ohm::Heightmap tiled(map.resolution(), 2 * map.resolution(), ohm::UpAxis::kZ, region_size);
+    tiled.setOccupancyMap(&map);
+    tiled.heightmap().setOrigin(map.origin());
+    tiled.setGenerateVirtualSurface(true);
+    tiled.setThreadCount(thread_count);
+
+    std::unordered_set<ohm::Key, ohm::Key::Hash> tile_keys;
+    size_t tile_count = 0;
+    const double tile_size = 2 * region_size * map.resolution();
+    const bool ok = tiled.buildHeightmapTiles(
+      reference_pos, ohm::Aabb(0.0), tile_size, 0.5,
+      [&](const ohm::HeightmapTile &tile, ohm::Heightmap &tile_heightmap) {
+        const ohm::OccupancyMap &tile_map = tile_heightmap.heightmap();
+        ohm::Voxel<const float> ref_occupancy(&full_map, full_map.layout().occupancyLayer());
+        ohm::Voxel<const ohm::HeightmapVoxel> ref_voxel(&full_map, full.heightmapVoxelLayer());
+        ohm::Voxel<const float> test_occupancy(&tile_map, tile_map.layout().occupancyLayer());
+        ohm::Voxel<const ohm::HeightmapVoxel> test_voxel(&tile_map, tile_heightmap.heightmapVoxelLayer());
+        for (auto iter = tile_map.begin(); iter != tile_map.end(); ++iter)
+        {
+          ohm::setVoxelKey(iter, test_occupancy, test_voxel);
+          if (test_occupancy.data() == ohm::unobservedOccupancyValue())
+          {
+            continue;
+          }
+
+          // Each voxel must be in the tile core and belong to only one tile.
+          const glm::dvec3 pos = tile_map.voxelCentreGlobal(*iter);
+          EXPECT_GE(pos.x, tile.extents.minExtents().x) << iter.key();
+          EXPECT_LE(pos.x, tile.extents.maxExtents().x) << iter.key();
+          EXPECT_GE(pos.y, tile.extents.minExtents().y) << iter.key();
+          EXPECT_LE(pos.y, tile.extents.maxExtents().y) << iter.key();
+          EXPECT_TRUE(tile_keys.insert(*iter).second) << iter.key();
+
+          ohm::setVoxelKey(*iter, ref_occupancy, ref_voxel);
+          EXPECT_TRUE(ref_occupancy.isValid()) << iter.key();
+          EXPECT_EQ(test_occupancy.data(), ref_occupancy.data()) << iter.key();
+          const ohm::HeightmapVoxel ref = ref_voxel.data();
+          const ohm::HeightmapVoxel voxel = test_voxel.data();
+          EXPECT_EQ(voxel.height, ref.height) << iter.key();
+          EXPECT_EQ(voxel.clearance, ref.clearance) << iter.key();
+        }
+
+        if (tile_count++ == 0)
+        {
+          // Validate saving a tile.
+          const std::string tile_file = "heightmap-tile.ohm";
+          EXPECT_EQ(ohm::save(tile_file, tile_heightmap), 0);
+          ohm::Heightmap loaded;
+          EXPECT_EQ(ohm::load(tile_file, loaded), 0);
+          compareHeightmaps(tile_heightmap, loaded);
+        }
+        return true;
+      });
+
+    ASSERT_TRUE(ok);
+    EXPECT_GT(tile_count, 1u);
+    EXPECT_EQ(tile_keys.size(), full_voxel_count);
+  }
+}
+
+
+TEST(Heightmap, Batch)
+{
+  // Batch generation with shared column searches must exactly match individual builds.
+  ohm::OccupancyMap map(0.1);
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const std::vector<glm::dvec3> route = { glm::dvec3(0, 0, 0.5 * params.platform_height),
+                                          glm::dvec3(0.5, 0.2, 0.5 * params.platform_height),
+                                          glm::dvec3(1.0, 0.4, 0.5 * params.platform_height),
+                                          glm::dvec3(1.0, 0.4, params.platform_height) };
+  const std::vector<ohm::Aabb> cull_to = { ohm::Aabb(glm::dvec3(-2, -2, -1), glm::dvec3(2, 2, 3)) };
+
+  for (const auto mode : { ohm::HeightmapMode::kPlanar, ohm::HeightmapMode::kSimpleFill,
+                           ohm::HeightmapMode::kLayeredFill })
+  {
+    for (unsigned thread_count : { 1u, 4u })
+    {
+      SCOPED_TRACE(std::to_string(int(mode)) + "/" + std::to_string(thread_count));
+      const auto configure = [&](ohm::Heightmap &heightmap) {
+        heightmap.setOccupancyMap(&map);
+        heightmap.heightmap().setOrigin(map.origin());
+        heightmap.setMode(mode);
+        heightmap.setGenerateVirtualSurface(true);
+        heightmap.setThreadCount(thread_count);
+      };
+
+      ohm::Heightmap batch(map.resolution(), 2 * map.resolution());
+      configure(batch);
+
+      size_t built_count = 0;
+      const bool ok = batch.buildHeightmaps(route, cull_to, [&](size_t index, ohm::Heightmap &heightmap) {
+        EXPECT_EQ(index, built_count);
+        ohm::Heightmap reference(map.resolution(), 2 * map.resolution());
+        configure(reference);
+        EXPECT_TRUE(reference.buildHeightmap(route[index], cull_to.front()));
+        compareHeightmaps(reference, heightmap);
+        ++built_count;
+        return true;
+      });
+      EXPECT_TRUE(ok);
+      EXPECT_EQ(built_count, route.size());
+    }
+  }
+
+  // Validate aborting and argument checks.
+  ohm::Heightmap heightmap(map.resolution(), 2 * map.resolution());
+  heightmap.setOccupancyMap(&map);
+  size_t built_count = 0;
+  EXPECT_FALSE(heightmap.buildHeightmaps(route, {}, [&built_count](size_t, ohm::Heightmap &) {
+    return ++built_count < 2;
+  }));
+  EXPECT_EQ(built_count, 2u);
+  EXPECT_FALSE(heightmap.buildHeightmaps(route, std::vector<ohm::Aabb>(2, cull_to.front())));
+}
+
+TEST(Heightmap, CompactSerialise)
+{
+  // Round trip heightmaps through the compact tile format and validate against the source to the quantisation limits.
+  ohm::OccupancyMap map(0.1);
+  HeightmapParams params;
+  params.generate_virtual_surfaces = true;
+  populateMultiLevelMap(map, params);
+
+  const std::vector<ohm::HeightmapTileCompression> compression_modes = {
+    ohm::HeightmapTileCompression::kNone, ohm::HeightmapTileCompression::kLz4, ohm::HeightmapTileCompression::kDeflate
+  };
+  for (const auto mode : { ohm::HeightmapMode::kPlanar, ohm::HeightmapMode::kLayeredFill })
+  {
+    ohm::Heightmap heightmap(map.resolution(), 2 * map.resolution());
+    heightmap.setOccupancyMap(&map);
+    heightmap.heightmap().setOrigin(map.origin());
+    heightmap.setMode(mode);
+    heightmap.setGenerateVirtualSurface(true);
+    ASSERT_TRUE(heightmap.buildHeightmap(glm::dvec3(0, 0, 0.5 * params.platform_height)));
+
+    for (const auto compression : compression_modes)
+    {
+      SCOPED_TRACE(std::to_string(int(mode)) + "/" + std::to_string(int(compression)));
+      ohm::HeightmapCompactOptions options;
+      options.compression = compression;
+      std::vector<uint8_t> buffer;
+      ASSERT_EQ(ohm::encodeCompact(heightmap, buffer, options), ohm::kSeOk);
+
+      // Decode into a heightmap with a different configuration.
+      ohm::Heightmap loaded(0.5, 0.0, ohm::UpAxis::kY);
+      ASSERT_EQ(ohm::decodeCompact(buffer.data(), buffer.size(), loaded), ohm::kSeOk);
+      EXPECT_EQ(loaded.upAxis(), heightmap.upAxis());
+      EXPECT_EQ(loaded.mode(), heightmap.mode());
+      EXPECT_EQ(loaded.minClearance(), heightmap.minClearance());
+      EXPECT_EQ(loaded.heightmap().resolution(), heightmap.heightmap().resolution());
+
+      const double height_tolerance = 0.5 * map.resolution() / 256.0 + 1e-4;
+      const double clearance_tolerance = 0.5 * map.resolution() / 16.0 + 1e-4;
+      const ohm::OccupancyMap &src_map = heightmap.heightmap();
+      Voxel<const HeightmapVoxel> src_voxel(&src_map, heightmap.heightmapVoxelLayer());
+      Voxel<const HeightmapVoxel> loaded_voxel(&loaded.heightmap(), loaded.heightmapVoxelLayer());
+      ASSERT_TRUE(loaded_voxel.isLayerValid());
+      for (auto iter = src_map.begin(); iter != src_map.end(); ++iter)
+      {
+        glm::dvec3 src_pos{};
+        glm::dvec3 loaded_pos{};
+        const HeightmapVoxelType src_type = heightmap.getHeightmapVoxelInfo(*iter, &src_pos);
+        ASSERT_EQ(int(loaded.getHeightmapVoxelInfo(*iter, &loaded_pos)), int(src_type));
+        if (src_type == HeightmapVoxelType::kUnknown)
+        {
+          continue;
+        }
+        ohm::setVoxelKey(*iter, src_voxel, loaded_voxel);
+        const HeightmapVoxel expect = src_voxel.data();
+        const HeightmapVoxel actual = loaded_voxel.data();
+        EXPECT_NEAR(actual.height, expect.height, height_tolerance);
+        EXPECT_NEAR(actual.clearance, expect.clearance, clearance_tolerance);
+        EXPECT_EQ(actual.layer, expect.layer);
+        EXPECT_EQ(actual.flags, expect.flags);
+      }
+    }
+  }
+
+  // Corrupt data is rejected.
+  ohm::Heightmap heightmap(map.resolution(), 2 * map.resolution());
+  std::vector<uint8_t> buffer;
+  ASSERT_EQ(ohm::encodeCompact(heightmap, buffer), ohm::kSeOk);
+  EXPECT_EQ(ohm::decodeCompact(buffer.data(), buffer.size() / 2, heightmap), ohm::kSeHeightmapCompactCorrupt);
+}
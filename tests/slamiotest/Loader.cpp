@@ -7,6 +7,9 @@
 
 #include "slamio/Points.h"
 #include "slamio/PointCloudReaderPly.h"
+#include "slamio/PointCloudReaderRayCloud.h"
+#include "slamio/RayCloudWriter.h"
+#include "slamio/SlamIO.h"
 
 #include <ohmutil/PlyPointStream.h>
 
@@ -109,4 +112,56 @@ TEST(Loader, Ply)
 
   EXPECT_EQ(read_count, point_count);
 }
+
+
+TEST(Loader, RayCloud)
+{
+  const std::string test_file_name = "test_loader.rcb";
+  const size_t ray_count = 1000;
+  const unsigned chunk_size = 64;
+
+  RayCloudWriter writer(chunk_size);
+  ASSERT_TRUE(writer.open(test_file_name.c_str()));
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    const glm::dvec3 origin(i * 0.1, 0.0, 1.0);
+    const glm::dvec3 sample(i * 0.1, i * -0.5, 0.0);
+    ASSERT_TRUE(writer.addRay(origin, sample, i * 0.01, float(i), uint8_t(i % 3)));
+  }
+  EXPECT_EQ(writer.rayCount(), ray_count);
+  ASSERT_TRUE(writer.close());
+
+  PointCloudReaderPtr reader = createCloudReaderFromFilename(test_file_name.c_str());
+  ASSERT_NE(dynamic_cast<PointCloudReaderRayCloud *>(reader.get()), nullptr);
+  ASSERT_TRUE(reader->open(test_file_name.c_str()));
+  EXPECT_EQ(reader->pointCount(), ray_count);
+
+  std::vector<CloudPoint> points(ray_count + 1);
+  ASSERT_EQ(reader->readChunk(points.data(), points.size()), ray_count);
+  for (size_t i = 0; i < ray_count; ++i)
+  {
+    const CloudPoint &pt = points[i];
+    EXPECT_EQ(pt.timestamp, i * 0.01) << i;
+    EXPECT_EQ(pt.position, glm::dvec3(i * 0.1, i * -0.5, 0.0)) << i;
+    EXPECT_EQ(pt.position + pt.normal, glm::dvec3(i * 0.1, 0.0, 1.0)) << i;
+    EXPECT_EQ(pt.intensity, float(i)) << i;
+    EXPECT_EQ(pt.return_number, uint8_t(i % 3)) << i;
+  }
+
+  // Random access by time and index, across chunk boundaries.
+  auto *ray_reader = static_cast<PointCloudReaderRayCloud *>(reader.get());
+  CloudPoint pt{};
+  ASSERT_TRUE(ray_reader->seekTime(7.005));
+  EXPECT_EQ(ray_reader->tell(), 701u);
+  ASSERT_TRUE(reader->readNext(pt));
+  EXPECT_EQ(pt.timestamp, 701 * 0.01);
+
+  ASSERT_TRUE(ray_reader->seekRay(chunk_size - 1));
+  ASSERT_EQ(reader->readChunk(points.data(), 2), 2u);
+  EXPECT_EQ(points[0].timestamp, (chunk_size - 1) * 0.01);
+  EXPECT_EQ(points[1].timestamp, chunk_size * 0.01);
+
+  EXPECT_FALSE(ray_reader->seekTime(1e6));
+  EXPECT_FALSE(ray_reader->seekRay(ray_count + 1));
+}
 }  // namespace slamio
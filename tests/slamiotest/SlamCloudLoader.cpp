@@ -11,9 +11,13 @@
 
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <fstream>
+#include <iostream>
 #include <limits>
 #include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace
@@ -138,6 +142,69 @@ TEST(SlamIO, SlamRead)
   }
 }
 
+TEST(SlamIO, SlamReadPipeline)
+{
+  std::vector<glm::dvec4> samples;
+  std::vector<glm::dvec4> trajectory;
+
+  generateSlamCloud(&samples, &trajectory);
+  const std::string sample_file = "slam-pipeline-samples.ply";
+  const std::string trajectory_file = "slam-pipeline-trajectory.ply";
+  writeTimestampedPlyCloud(sample_file.c_str(), samples);
+  writeTimestampedPlyCloud(trajectory_file.c_str(), trajectory);
+
+  // Read without the pipeline for reference.
+  std::vector<slamio::SamplePoint> expected;
+  {
+    slamio::SlamCloudLoader reader;
+    ASSERT_TRUE(reader.openWithTrajectory(sample_file.c_str(), trajectory_file.c_str()));
+    slamio::SamplePoint sample{};
+    while (reader.nextSample(sample))
+    {
+      expected.emplace_back(sample);
+    }
+  }
+  ASSERT_EQ(expected.size(), samples.size());
+
+  slamio::SlamCloudLoader reader;
+  reader.setErrorLog([](const char *msg) { std::cerr << msg << std::flush; });
+  reader.enablePipeline(true);
+  // Use a chunk size which does not divide the sample count.
+  reader.setPipelineChunkSize(777);  // NOLINT(readability-magic-numbers)
+  reader.setPipelineQueueDepth(2);
+  ASSERT_TRUE(reader.openWithTrajectory(sample_file.c_str(), trajectory_file.c_str()));
+  // Preload some points to ensure we transition from the preloaded samples to the pipeline.
+  reader.preload(100);  // NOLINT(readability-magic-numbers)
+
+  // Mix single sample and batch reads.
+  std::vector<slamio::SamplePoint> loaded;
+  std::vector<slamio::SamplePoint> batch;
+  slamio::SamplePoint sample{};
+  for (int i = 0; i < 10 && reader.nextSample(sample); ++i)  // NOLINT(readability-magic-numbers)
+  {
+    loaded.emplace_back(sample);
+  }
+  while (reader.nextSamples(batch) > 0)
+  {
+    EXPECT_LE(batch.size(), reader.pipelineChunkSize());
+    loaded.insert(loaded.end(), batch.begin(), batch.end());
+  }
+  EXPECT_FALSE(reader.nextSample(sample));
+
+  ASSERT_EQ(loaded.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+  {
+    ASSERT_EQ(loaded[i].timestamp, expected[i].timestamp);
+    ASSERT_EQ(loaded[i].sample, expected[i].sample);
+    ASSERT_EQ(loaded[i].origin, expected[i].origin);
+  }
+
+  // Closing with pending data must stop the pipeline cleanly.
+  ASSERT_TRUE(reader.openWithTrajectory(sample_file.c_str(), trajectory_file.c_str()));
+  ASSERT_TRUE(reader.nextSample(sample));
+  reader.close();
+}
+
 TEST(SlamIO, CloudRead)
 {
   std::vector<glm::dvec4> samples;
@@ -190,4 +257,129 @@ TEST(SlamIO, TrajectoryRead)
     ASSERT_NEAR(point.position.z, trajectory[i].z, e0);
   }
 }
+
+TEST(SlamIO, MultiSensorRead)
+{
+  std::vector<glm::dvec4> trajectory;
+  generateSlamCloud(nullptr, &trajectory);
+  const std::string trajectory_file = "multi-sensor-trajectory.txt";
+  writeTextTrajectory(trajectory_file, trajectory);
+
+  // Generate interleaved sample times for two sensors at different rates.
+  const unsigned sensor_count = 2;
+  const double sensor_period[sensor_count] = { 2e-3, 3e-3 };
+  std::vector<std::string> sample_files;
+  size_t total_samples = 0;
+  for (unsigned s = 0; s < sensor_count; ++s)
+  {
+    std::vector<glm::dvec4> samples;
+    for (double time = 0.5 * s * sensor_period[0]; time < data_time - 0.1; time += sensor_period[s])
+    {
+      samples.emplace_back(glm::dvec4(double(s + 1), 0.0, 0.0, time));
+    }
+    total_samples += samples.size();
+    sample_files.emplace_back("multi-sensor-samples" + std::to_string(s) + ".ply");
+    writeTimestampedPlyCloud(sample_files.back(), samples);
+  }
+
+  std::vector<SlamCloudLoader::SensorInput> inputs(sensor_count);
+  for (unsigned s = 0; s < sensor_count; ++s)
+  {
+    inputs[s].sample_file_path = sample_files[s];
+    inputs[s].sensor_transform[3] = glm::dvec4(0.0, 0.0, 0.1 * s, 1.0);
+  }
+
+  SlamCloudLoader reader;
+  reader.setErrorLog([](const char *msg) { std::cerr << msg << std::flush; });
+  ASSERT_TRUE(reader.openMultiSensor(inputs, trajectory_file.c_str()));
+  EXPECT_EQ(reader.numberOfPoints(), total_samples);
+
+  SamplePoint sample{};
+  size_t read_count = 0;
+  double last_time = -1.0;
+  while (reader.nextSample(sample))
+  {
+    ASSERT_LT(sample.sensor_index, sensor_count);
+    ASSERT_GE(sample.timestamp, last_time);
+    EXPECT_EQ(sample.sample.x, double(sample.sensor_index + 1));
+    const glm::dvec3 expected_origin =
+      glm::dvec3(generateTrajectoryPoint(sample.timestamp)) + glm::dvec3(0.0, 0.0, 0.1 * sample.sensor_index);
+    EXPECT_NEAR(sample.origin.x, expected_origin.x, 1e-9);
+    EXPECT_NEAR(sample.origin.y, expected_origin.y, 1e-9);
+    EXPECT_NEAR(sample.origin.z, expected_origin.z, 1e-9);
+    last_time = sample.timestamp;
+    ++read_count;
+  }
+
+  EXPECT_EQ(read_count, total_samples);
+}
+
+TEST(SlamIO, RealTimeReplay)
+{
+  // Generate samples covering a short time span.
+  const size_t replay_samples = 2000;
+  const double replay_time = 0.4;
+  std::vector<glm::dvec4> samples;
+  for (size_t i = 0; i < replay_samples; ++i)
+  {
+    samples.emplace_back(glm::dvec4(1.0, 2.0, 3.0, replay_time * double(i) / double(replay_samples - 1)));
+  }
+  const std::string sample_file = "real-time-samples.ply";
+  writeTimestampedPlyCloud(sample_file, samples);
+
+  using Clock = std::chrono::steady_clock;
+
+  // Replay at twice real time without dropping data.
+  {
+    SlamCloudLoader reader(true);
+    reader.setErrorLog([](const char *msg) { std::cerr << msg << std::flush; });
+    reader.setRealTimeRate(2.0);
+    ASSERT_TRUE(reader.openPointCloud(sample_file.c_str()));
+
+    std::vector<SamplePoint> batch;
+    size_t read_count = 0;
+    double last_time = -1.0;
+    const auto start_time = Clock::now();
+    while (reader.nextSamples(batch) > 0)
+    {
+      EXPECT_LE(batch.back().timestamp - batch.front().timestamp, reader.realTimeBatchPeriod());
+      for (const auto &sample : batch)
+      {
+        ASSERT_GE(sample.timestamp, last_time);
+        last_time = sample.timestamp;
+      }
+      read_count += batch.size();
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    EXPECT_EQ(read_count, replay_samples);
+    EXPECT_GE(elapsed, 0.9 * replay_time / reader.realTimeRate());
+    const SlamCloudLoader::RealTimeStats stats = reader.realTimeStats();
+    EXPECT_GT(stats.batches, 0u);
+    EXPECT_EQ(stats.dropped_batches, 0u);
+    EXPECT_EQ(stats.dropped_samples, 0u);
+    EXPECT_GE(stats.max_lag, stats.mean_lag);
+  }
+
+  // Slow consumer dropping the newest data.
+  {
+    SlamCloudLoader reader(true);
+    reader.setErrorLog([](const char *msg) { std::cerr << msg << std::flush; });
+    reader.setPipelineQueueDepth(1);
+    reader.setRealTimeDropPolicy(SlamCloudLoader::DropPolicy::kDropNewest);
+    ASSERT_TRUE(reader.openPointCloud(sample_file.c_str()));
+
+    std::vector<SamplePoint> batch;
+    size_t read_count = 0;
+    while (reader.nextSamples(batch) > 0)
+    {
+      read_count += batch.size();
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    const SlamCloudLoader::RealTimeStats stats = reader.realTimeStats();
+    EXPECT_GT(stats.dropped_batches, 0u);
+    EXPECT_EQ(read_count + stats.dropped_samples, replay_samples);
+  }
+}
 }  // namespace slamio
@@ -3,6 +3,7 @@
 //
 #include <glm/glm.hpp>
 
+#include <ohm/CopyUtil.h>
 #include <ohm/DefaultLayer.h>
 #include <ohm/Key.h>
 #include <ohm/KeyList.h>
@@ -12,6 +13,7 @@
 #include <ohm/MapSerialise.h>
 #include <ohm/OccupancyMap.h>
 #include <ohm/OccupancyType.h>
+#include <ohm/ParallelForEach.h>
 #include <ohm/VoxelData.h>
 
 #include <ohmheightmap/Heightmap.h>
@@ -30,6 +32,7 @@
 #include <glm/mat3x3.hpp>
 #include <glm/vec3.hpp>
 
+#include <ohm/CovarianceEigenCache.h>
 #include <ohm/CovarianceVoxel.h>
 
 #include <algorithm>
@@ -118,6 +121,8 @@ struct Options
   ExportMode mode = kExportOccupancy;
   ColourModeOrValue colour = ColourModeOrValue(kColourHeight);
   VoxelMode voxel_mode = kVoxelPoint;
+  unsigned region_window = 256;
+  bool stream = false;
 
   HeightmapOptions heightmap;
 };
@@ -462,6 +467,10 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
                     cxxopts::value(opt->threshold)->default_value(optStr(opt->threshold)))
       ("max-intensity", "Maximum expected intensity value. For use with --colour=intensity, this is the value at which the colour saturates.", optVal(opt->max_intensity))
       ("voxel-mode", "Voxel export mode [point,voxel]: select the ply representation for voxels.", cxxopts::value(opt->voxel_mode)->default_value(optStr(opt->voxel_mode)))
+      ("stream", "Stream regions from an indexed map file rather than loading the whole map, supporting maps larger "
+                 "than memory. Only supported for point exports in occupancy, occupancy-centre, observed and density "
+                 "modes, without --cull or --expire. Other maps and modes load the whole map.", optVal(opt->stream))
+      ("stream-window", "The number of regions to keep in memory at a time with --stream.", optVal(opt->region_window))
       ;
 
     opt_parse.add_options("Heightmap")
@@ -501,12 +510,76 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
 }
 
 
+/// Can @p opt be exported by streaming regions from an indexed map file?
+bool canStream(const Options &opt)
+{
+  switch (opt.mode)
+  {
+  case kExportOccupancy:
+  case kExportOccupancyCentre:
+  case kExportObserved:
+  case kExportDensity:
+    break;
+  default:
+    return false;
+  }
+
+  return opt.voxel_mode == kVoxelPoint && opt.cull_distance <= 0 && opt.expiry_time <= 0;
+}
+
+
+/// Open @p map for streaming with only the layers required by @p opt loaded eagerly. Maps which are not indexed map
+/// files are loaded in full.
+/// @param opt The export options.
+/// @param map The map to open.
+/// @param[out] streaming Set to true when the map is an indexed map which can be streamed.
+/// @return Zero on success or a @c ohm::SerialisationError code.
+int openStreamedMap(const Options &opt, ohm::OccupancyMap &map, bool &streaming)
+{
+  std::vector<std::string> eager_layers = { ohm::default_layer::occupancyLayerName() };
+  if (opt.mode == kExportOccupancy || opt.mode == kExportDensity)
+  {
+    eager_layers.emplace_back(ohm::default_layer::meanLayerName());
+  }
+  if (opt.mode == kExportDensity)
+  {
+    eager_layers.emplace_back(ohm::default_layer::traversalLayerName());
+  }
+  if (opt.colour.mode == kColourIntensity)
+  {
+    eager_layers.emplace_back(ohm::default_layer::intensityLayerName());
+  }
+
+  ohm::MapVersion version{};
+  const int res = ohm::openIndexed(opt.map_file, map, ohm::copyLayersFilter(eager_layers), &version);
+  streaming = res == 0 && version == ohm::kIndexedVersion;
+  return res;
+}
+
+
 int exportPointCloud(const Options &opt, ProgressMonitor &prog, LoadMapProgress &load_progress)
 {
   ohm::OccupancyMap map(1.0f);
+  bool streaming = false;
+  int res = 0;
 
   prog.startThread();
-  int res = ohm::load(opt.map_file.c_str(), map, &load_progress);
+  if (opt.stream && canStream(opt))
+  {
+    res = openStreamedMap(opt, map, streaming);
+    if (res == 0 && !streaming)
+    {
+      std::cout << "Not an indexed map. Loaded the whole map." << std::endl;
+    }
+  }
+  else
+  {
+    if (opt.stream)
+    {
+      std::cout << "Streaming is not supported for the export options. Loading the whole map." << std::endl;
+    }
+    res = ohm::load(opt.map_file.c_str(), map, &load_progress);
+  }
   prog.endProgress();
 
   std::cout << std::endl;
@@ -605,7 +678,8 @@ int exportPointCloud(const Options &opt, ProgressMonitor &prog, LoadMapProgress
   }
 
   std::cout << "Converting to PLY cloud" << std::endl;
-  const size_t region_count = map.regionCount();
+  std::vector<glm::i16vec3> indexed_regions;
+  const size_t region_count = (streaming) ? map.enumerateIndexedRegions(indexed_regions) : map.regionCount();
   // uint64_t point_count = 0;
 
   prog.beginProgress(ProgressMonitor::Info(region_count));
@@ -642,9 +716,14 @@ int exportPointCloud(const Options &opt, ProgressMonitor &prog, LoadMapProgress
       };
       break;
     case kColourHeight:
-      save_opt.colour_select = [&colour_by_height](const ohm::Voxel<const float> &occupancy) {
-        return colour_by_height.select(occupancy);
-      };
+      // The streamed map has no regions resident to take the extents from. Use the default selection, which colours
+      // across the extents of the file index instead.
+      if (!streaming)
+      {
+        save_opt.colour_select = [&colour_by_height](const ohm::Voxel<const float> &occupancy) {
+          return colour_by_height.select(occupancy);
+        };
+      }
       break;
     case kColourOccupancy:
       save_opt.colour_select = [&colour_by_occupancy](const ohm::Voxel<const float> &occupancy) {
@@ -671,6 +750,11 @@ int exportPointCloud(const Options &opt, ProgressMonitor &prog, LoadMapProgress
     {
       export_count = saveVoxels(opt.ply_file.c_str(), map, save_opt, save_progress_callback);
     }
+    else if (streaming)
+    {
+      save_opt.region_window = opt.region_window;
+      export_count = streamCloud(opt.ply_file.c_str(), map, save_opt, save_progress_callback);
+    }
     else
     {
       export_count = saveCloud(opt.ply_file.c_str(), map, save_opt, save_progress_callback);
@@ -683,7 +767,15 @@ int exportPointCloud(const Options &opt, ProgressMonitor &prog, LoadMapProgress
     save_opt.ignore_voxel_mean = false;
     save_opt.allow_default_colour_selection = true;
     save_opt.density_threshold = opt.threshold;
-    export_count = saveDensityCloud(opt.ply_file.c_str(), map, save_opt, save_progress_callback);
+    if (streaming)
+    {
+      save_opt.region_window = opt.region_window;
+      export_count = streamDensityCloud(opt.ply_file.c_str(), map, save_opt, save_progress_callback);
+    }
+    else
+    {
+      export_count = saveDensityCloud(opt.ply_file.c_str(), map, save_opt, save_progress_callback);
+    }
     break;
   }
   case kExportHeightmap:
@@ -899,7 +991,6 @@ int exportCovariance(const Options &opt, ProgressMonitor &prog, LoadMapProgress
   };
 
   const size_t region_count = map.regionCount();
-  glm::i16vec3 last_region = map.begin().key().regionKey();
 
   ohm::Voxel<const float> occupancy(&map, map.layout().occupancyLayer());
   ohm::Voxel<const ohm::VoxelMean> mean(&map, map.layout().meanLayer());
@@ -972,36 +1063,113 @@ int exportCovariance(const Options &opt, ProgressMonitor &prog, LoadMapProgress
 
   prog.beginProgress(ProgressMonitor::Info(region_count));
 
-  for (auto iter = map.begin(); iter != map.end() && !g_quit; ++iter)
+  // Resolve the ellipsoid transforms in parallel, then add them to the PLY in region order. Colour selection stays on
+  // this thread as the ColourSelect functions are not thread safe.
+  struct Ellipsoid
   {
-    ohm::setVoxelKey(*iter, occupancy, mean, covariance);
-    if (last_region != iter->regionKey())
-    {
-      prog.incrementProgress();
-      last_region = iter.key().regionKey();
-    }
+    glm::dmat4 transform;
+    ohm::Key key;
+  };
+
+  // Regions processed in parallel before adding to the PLY.
+  const size_t region_window = 256u;
+  std::vector<const ohm::MapChunk *> chunks;
+  map.enumerateRegions(chunks);
+  const glm::ivec3 region_voxel_dimensions = map.regionVoxelDimensions();
+  std::vector<std::vector<Ellipsoid>> region_ellipsoids(std::min(chunks.size(), region_window));
+  std::vector<const ohm::MapChunk *> window;
 
-    if (!ohm::isOccupied(occupancy))
+  struct WorkerVoxels
+  {
+    ohm::Voxel<const float> occupancy;
+    ohm::Voxel<const ohm::VoxelMean> mean;
+    ohm::Voxel<const ohm::CovarianceVoxel> covariance;
+  };
+  ohm::WorkerLocal<WorkerVoxels> worker_voxels(WorkerVoxels{ occupancy, mean, covariance });
+
+  const auto resolve_ellipsoids = [&worker_voxels, &region_ellipsoids, &region_voxel_dimensions](
+                                    const ohm::MapChunk &chunk, size_t region_index, unsigned worker_index) {
+    WorkerVoxels &voxels = worker_voxels.local(worker_index);
+    std::vector<Ellipsoid> &ellipsoids = region_ellipsoids[region_index];
+    ellipsoids.clear();
+
+    // Decompose the covariance of the occupied voxels in batches. The ellipsoid transform holds the voxel position
+    // until the batch is resolved.
+    ohm::CovarianceEigenBatch batch;
+    const auto resolve_batch = [&batch, &ellipsoids]() {
+      ohm::covarianceEigenDecompositionBatch(batch);
+      const size_t batch_start = ellipsoids.size() - batch.count;
+      for (unsigned lane = 0; lane < batch.count; ++lane)
+      {
+        glm::dmat3 axes;
+        glm::dvec3 values;
+        batch.getDecomposition(lane, &axes, &values);
+        ohm::CovarianceEigen eigen;
+        eigen.axes = glm::mat3(axes);
+        eigen.values = glm::vec3(values);
+
+        glm::dquat rot;
+        glm::dvec3 scale;
+        eigen.unitSphereTransformation(&rot, &scale);
+        // For rendering niceness, we scale up a bit to get better overlap between voxels.
+        const double scale_factor = std::sqrt(3.0);
+        scale *= scale_factor;
+
+        Ellipsoid &ellipsoid = ellipsoids[batch_start + lane];
+        ellipsoid.transform = ellipsoid.transform * glm::mat4_cast(rot) * glm::scale(scale);
+      }
+      batch.count = 0;
+    };
+
+    ohm::forEachVoxelInRegion(
+      chunk, region_voxel_dimensions, [&voxels, &ellipsoids, &chunk, &batch, &resolve_batch](const ohm::Key &key) {
+        voxels.occupancy.setKey(key, &chunk);
+        if (!ohm::isOccupied(voxels.occupancy))
+        {
+          return;
+        }
+
+        voxels.mean.setKey(key, &chunk);
+        voxels.covariance.setKey(key, &chunk);
+        const glm::dvec3 pos = ohm::positionSafe(voxels.mean);
+        ohm::CovarianceVoxel cov;
+        voxels.covariance.read(&cov);
+
+        batch.add(cov);
+        ellipsoids.emplace_back(Ellipsoid{ glm::translate(pos), key });
+        if (batch.count == ohm::kCovarianceBatchWidth)
+        {
+          resolve_batch();
+        }
+      });
+
+    if (batch.count)
     {
-      continue;
+      resolve_batch();
     }
+  };
 
-    const glm::dvec3 pos = ohm::positionSafe(mean);
-    ohm::CovarianceVoxel cov;
-    covariance.read(&cov);
-
-    // Add an ellipsoid to the PLY
-    glm::dquat rot;
-    glm::dvec3 scale;
-    ohm::covarianceUnitSphereTransformation(&cov, &rot, &scale);
-    // For rendering niceness, we scale up a bit to get better overlap between voxels.
-    const double scale_factor = std::sqrt(3.0);
-    scale *= scale_factor;
+  for (size_t window_start = 0; window_start < chunks.size() && !g_quit; window_start += region_window)
+  {
+    const size_t window_end = std::min(window_start + region_window, chunks.size());
+    window.assign(chunks.begin() + window_start, chunks.begin() + window_end);
+    ohm::parallelForEachRegion(window, resolve_ellipsoids);
 
-    const glm::dmat4 transform = glm::translate(pos) * glm::mat4_cast(rot) * glm::scale(scale);
-    add_ellipsoid(ply, transform, colour_select(occupancy));
+    for (size_t i = 0; i < window.size(); ++i)
+    {
+      for (const Ellipsoid &ellipsoid : region_ellipsoids[i])
+      {
+        // Add an ellipsoid to the PLY
+        occupancy.setKey(ellipsoid.key, window[i]);
+        add_ellipsoid(ply, ellipsoid.transform, colour_select(occupancy));
+      }
+      prog.incrementProgress();
+    }
   }
 
+  // Release the worker voxel references before saving.
+  worker_voxels.items().clear();
+
 #if OHM_COV_DEBUG
   ohm::covDebugStats();
 #endif  // OHM_COV_DEBUG
@@ -43,10 +43,12 @@ struct Options
   std::string ref_map_file;
   std::vector<std::string> layers;
   unsigned verbosity = 1;
+  size_t max_failures = 0;
   bool compare_layout = false;
   bool compare_voxels = false;
   bool stop_on_error = false;
   bool tolerances = false;
+  bool parallel = false;
 };
 }  // namespace
 
@@ -65,6 +67,8 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
       ("ref", "The reference map file (ohm) to validate against.", cxxopts::value(opt->ref_map_file))
       ("layers", "List of layers to limit comparison to. Affects layout and voxel comparison.", cxxopts::value(opt->layers))
       ("layout", "Compare map layouts and report differences?", optVal(opt->compare_layout))
+      ("max-failures", "Stop comparing voxels in a layer after this many failures. Zero for no limit.", optVal(opt->max_failures))
+      ("parallel", "Compare voxel regions in parallel?", optVal(opt->parallel))
       ("stop-on-error", "Stop on the first error?", optVal(opt->stop_on_error))
       ("tolerances", "Allow some error tolerance?.", optVal(opt->tolerances))
       ("verbosity", "Verbosity level [0, 2].", optVal(opt->verbosity))
@@ -337,6 +341,7 @@ int main(int argc, char *argv[])
 
   unsigned compare_flags = 0;
   compare_flags |= ohm::compare::kContinue * !opt.stop_on_error;
+  compare_flags |= ohm::compare::kParallel * opt.parallel;
 
   bool ok = true;
 
@@ -375,11 +380,15 @@ int main(int argc, char *argv[])
     {
       std::shared_ptr<ohm::MapLayer> tolerance = tolerances[layer_name];
 
-      auto voxel_result =
-        ohm::compare::compareVoxels(input_map, ref_map, layer_name, tolerance.get(), compare_flags, logs[2]);
+      ohm::compare::VoxelsOptions voxels_options;
+      voxels_options.tolerance = tolerance.get();
+      voxels_options.flags = compare_flags;
+      voxels_options.max_failures = opt.max_failures;
+      auto voxel_result = ohm::compare::compareVoxels(input_map, ref_map, layer_name, voxels_options, logs[2]);
       voxels_ok = voxel_result.layout_match && voxel_result.voxels_failed == 0 && voxels_ok;
       std::cout << layer_name << " layout " << (voxel_result.layout_match ? "ok" : "failed") << " passed "
-                << voxel_result.voxels_passed << " failed " << voxel_result.voxels_failed << std::endl;
+                << voxel_result.voxels_passed << " failed " << voxel_result.voxels_failed << " identical regions "
+                << voxel_result.regions_skipped << std::endl;
     }
     std::cout << "Voxels " << (voxels_ok ? "ok" : "failed") << std::endl;
     ok = ok && voxels_ok;
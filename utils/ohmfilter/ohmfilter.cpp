@@ -17,11 +17,18 @@
 
 #include <glm/gtc/matrix_access.hpp>
 
+#ifdef OHM_FEATURE_THREADS
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // OHM_FEATURE_THREADS
+
 #include <csignal>
+#include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 namespace
 {
@@ -35,8 +42,6 @@ void onSignal(int arg)
   }
 }
 
-using FilterFunction = std::function<bool(double, const glm::dvec3 &, const ohm::Key &)>;
-
 struct Options
 {
   std::string map_file;
@@ -44,10 +49,27 @@ struct Options
   std::string traj_in;
   std::string cloud_out;
   double expected_value_tolerance = -1;
+  unsigned batch_size = 65536u;  // NOLINT(readability-magic-numbers)
   bool occupancy_only = false;
+  bool no_threads = false;
   bool quiet = false;
 };
 
+/// Voxel references used to filter points. Each filtering thread uses its own set so the voxels cache the current
+/// chunk of that thread.
+struct FilterVoxels
+{
+  ohm::Voxel<const float> occ;
+  ohm::Voxel<const ohm::VoxelMean> mean;
+  ohm::Voxel<const ohm::CovarianceVoxel> cov;
+
+  explicit FilterVoxels(const ohm::OccupancyMap &map)
+    : occ(&map, map.layout().occupancyLayer())
+    , mean(&map, map.layout().meanLayer())
+    , cov(&map, map.layout().covarianceLayer())
+  {}
+};
+
 class LoadMapProgress : public ohm::SerialiseProgress
 {
 public:
@@ -89,6 +111,33 @@ bool filterPointByCovariance(const glm::dvec3 &point, const glm::dvec3 &mean, co
   const double expected_value = 3.0;  // In R3 => expected value is 3.
   return std::abs(value) < expected_value + threshold;
 }
+
+
+/// Check if @p point passes the filter: it must fall in an occupied voxel and, with @p use_ndt and a non-negative
+/// @p tolerance , be consistent with the voxel covariance.
+bool filterPoint(const glm::dvec3 &point, const ohm::Key &key, FilterVoxels &voxels, bool use_ndt, double tolerance)
+{
+  if (!use_ndt)
+  {
+    voxels.occ.setKey(key);
+    return ohm::isOccupied(voxels.occ);
+  }
+
+  ohm::setVoxelKey(key, voxels.occ, voxels.mean, voxels.cov);
+  if (ohm::isOccupied(voxels.occ))
+  {
+    if (tolerance >= 0)
+    {
+      const glm::dvec3 mean = ohm::positionUnsafe(voxels.mean);
+      ohm::CovarianceVoxel cov_data;
+      voxels.cov.read(&cov_data);
+      return filterPointByCovariance(point, mean, ohm::covarianceSqrtMatrix(&cov_data), tolerance);
+    }
+    return true;
+  }
+
+  return false;
+}
 }  // namespace
 
 // Must be after argument streaming operators.
@@ -115,6 +164,8 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
                     "point against it's voxel's covariance while a positive value expands the tolerance beyond the "
                     "expected value. A negative value disables this check.",
         cxxopts::value(opt->expected_value_tolerance))
+      ("batch-size", "Number of points read and filtered in each batch.", optVal(opt->batch_size))
+      ("no-threads", "Disable multi-threaded filtering.", optVal(opt->no_threads))
       ("quiet", "Limited log output.", optVal(opt->quiet))
       ;
     // clang-format on
@@ -145,6 +196,11 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
       std::cerr << "Missing output file name" << std::endl;
       return -1;
     }
+    if (opt->batch_size == 0)
+    {
+      std::cerr << "Batch size must be positive" << std::endl;
+      return -1;
+    }
   }
   catch (const cxxopts::OptionException &e)
   {
@@ -160,6 +216,9 @@ bool filterCloud(const Options &opt, const ohm::OccupancyMap &map, ProgressMonit
   // Use the SlamCloudLoader with no trajectory specified to load the cloud - it's just convenient.
   slamio::SlamCloudLoader cloud_loader;
   cloud_loader.setErrorLog([](const char *msg) { std::cerr << msg << std::flush; });
+  // Read in batches on background threads while the previous batch is filtered.
+  cloud_loader.enablePipeline(true);
+  cloud_loader.setPipelineChunkSize(opt.batch_size);
 
   if (!cloud_loader.openWithTrajectory(opt.cloud_in.c_str(), opt.traj_in.c_str()))
   {
@@ -170,54 +229,19 @@ bool filterCloud(const Options &opt, const ohm::OccupancyMap &map, ProgressMonit
   prog->beginProgress(ProgressMonitor::Info("filtering", cloud_loader.numberOfPoints()));
   prog->unpause();
 
-  // Prepare required data layers.
-  ohm::Voxel<const ohm::CovarianceVoxel> voxel_cov(&map, map.layout().covarianceLayer());
-  ohm::Voxel<const ohm::VoxelMean> voxel_mean(&map, map.layout().meanLayer());
-  ohm::Voxel<const float> voxel_occ(&map, map.layout().occupancyLayer());
-
-  if (!voxel_occ.isLayerValid())
+  // Validate required data layers.
+  const FilterVoxels layer_check(map);
+  if (!layer_check.occ.isLayerValid())
   {
     std::cerr << "Error: Map missing occupancy layer" << std::endl;
     return false;
   }
 
-  // Select the filter function depending on available layers.
-  FilterFunction filter;
-  glm::dmat3 cov_sqrt{};
-  if (!opt.occupancy_only && voxel_cov.isLayerValid() && voxel_mean.isLayerValid())
-  {
-    if (!opt.quiet)
-    {
-      std::cout << "Filtering with NDT information" << std::endl;
-    }
-    filter = [&](double /* timestamp */, const glm::dvec3 &point, const ohm::Key &key) -> bool {
-      ohm::setVoxelKey(key, voxel_occ, voxel_mean, voxel_cov);
-      if (ohm::isOccupied(voxel_occ))
-      {
-        const glm::dvec3 mean = ohm::positionUnsafe(voxel_mean);
-        ohm::CovarianceVoxel cov_data;
-        voxel_cov.read(&cov_data);
-        cov_sqrt = ohm::covarianceSqrtMatrix(&cov_data);
-        if (opt.expected_value_tolerance >= 0)
-        {
-          return filterPointByCovariance(point, mean, cov_sqrt, opt.expected_value_tolerance);
-        }
-        return true;
-      }
-
-      return false;
-    };
-  }
-  else
+  // Select the filter depending on available layers.
+  const bool use_ndt = !opt.occupancy_only && layer_check.cov.isLayerValid() && layer_check.mean.isLayerValid();
+  if (!opt.quiet)
   {
-    if (!opt.quiet)
-    {
-      std::cout << "Filtering using occupancy only" << std::endl;
-    }
-    filter = [&](double /* timestamp */, const glm::dvec3 & /* point */, const ohm::Key &key) -> bool {
-      voxel_occ.setKey(key);
-      return ohm::isOccupied(voxel_occ);
-    };
+    std::cout << ((use_ndt) ? "Filtering with NDT information" : "Filtering using occupancy only") << std::endl;
   }
 
   std::ofstream out(opt.cloud_out.c_str(), std::ios::binary);
@@ -236,27 +260,61 @@ bool filterCloud(const Options &opt, const ohm::OccupancyMap &map, ProgressMonit
   {
     std::cout << "Exporting to " << opt.cloud_out << std::endl;
   }
-  ohm::Key key;
+
   std::uint64_t point_count = 0;
   std::uint64_t export_count = 0;
   const bool with_trajectory = !opt.traj_in.empty();
-  slamio::SamplePoint sample{};
-  while (cloud_loader.nextSample(sample))
+  std::vector<slamio::SamplePoint> samples;
+  std::vector<uint8_t> keep;
+
+  // Filter a range of the current batch. The map is only read, so ranges may be filtered concurrently, each with
+  // its own voxel references.
+  const auto filter_range = [&](size_t begin, size_t end) {
+    FilterVoxels voxels(map);
+    for (size_t i = begin; i < end; ++i)
+    {
+      const glm::dvec3 &point = samples[i].sample;
+      keep[i] = uint8_t(filterPoint(point, map.voxelKey(point), voxels, use_ndt, opt.expected_value_tolerance));
+    }
+  };
+
+  while (!g_quit && cloud_loader.nextSamples(samples, opt.batch_size))
   {
-    key = map.voxelKey(sample.sample);
-    if (filter(sample.timestamp, sample.sample, key))
+    keep.resize(samples.size());
+#ifdef OHM_FEATURE_THREADS
+    if (!opt.no_threads)
+    {
+      const size_t grain_size = 1024u;
+      tbb::parallel_for(tbb::blocked_range<size_t>(0u, samples.size(), grain_size),
+                        [&filter_range](const tbb::blocked_range<size_t> &range) {
+                          filter_range(range.begin(), range.end());
+                        });
+    }
+    else
+#endif  // OHM_FEATURE_THREADS
     {
-      ply.setPointPosition(sample.sample);
-      if (with_trajectory)
+      filter_range(0, samples.size());
+    }
+
+    // Write in input order.
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+      if (keep[i])
       {
-        ply.setPointNormal(sample.sample - sample.origin);
+        const slamio::SamplePoint &sample = samples[i];
+        ply.setPointPosition(sample.sample);
+        if (with_trajectory)
+        {
+          ply.setPointNormal(sample.sample - sample.origin);
+        }
+        ply.setPointTimestamp(sample.timestamp);
+        ply.writePoint();
+        ++export_count;
       }
-      ply.setPointTimestamp(sample.timestamp);
-      ply.writePoint();
-      ++export_count;
     }
-    prog->incrementProgress();
-    ++point_count;
+
+    prog->incrementProgressBy(samples.size());
+    point_count += samples.size();
   }
   prog->endProgress();
   prog->pause();
@@ -0,0 +1,254 @@
+// Copyright (c) 2021
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Generate synthetic maps, trajectories and lidar ray clouds from procedural environments for benchmarking.
+
+#include <glm/glm.hpp>
+
+#include <ohm/MapSerialise.h>
+#include <ohm/OccupancyMap.h>
+#include <ohm/RayMapperOccupancy.h>
+
+#include <ohmtools/OhmScenario.h>
+
+#include <ohmutil/GlmStream.h>
+
+#include <slamio/RayCloudWriter.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <string>
+#include <vector>
+
+// Must be after argument streaming operators.
+#include <ohmutil/Options.h>
+
+namespace
+{
+using Clock = std::chrono::high_resolution_clock;
+
+struct Options
+{
+  std::string scenario = "urban";
+  std::string map_out;
+  std::string rays_out;
+  std::string trajectory_out;
+  std::string map_mode = "truth";
+  ohmgen::ScenarioParams params;
+  ohmgen::LidarParams lidar;
+  double resolution = 0.1;           // NOLINT(readability-magic-numbers)
+  double speed = 2.0;                // NOLINT(readability-magic-numbers)
+  double trajectory_interval = 0.1;  // NOLINT(readability-magic-numbers)
+  bool fill_free = false;
+  bool no_threads = false;
+};
+
+
+double elapsedSeconds(const Clock::time_point &start_time)
+{
+  return std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time).count();
+}
+
+
+bool saveTrajectory(const std::string &path, const std::vector<ohmgen::TrajectorySample> &trajectory)
+{
+  std::ofstream out(path.c_str());
+  if (!out.is_open())
+  {
+    return false;
+  }
+
+  // Format read by slamio: time x y z
+  out << std::fixed << std::setprecision(6);  // NOLINT(readability-magic-numbers)
+  for (const ohmgen::TrajectorySample &sample : trajectory)
+  {
+    out << sample.timestamp << ' ' << sample.position.x << ' ' << sample.position.y << ' ' << sample.position.z
+        << '\n';
+  }
+  return out.good();
+}
+
+
+bool saveRays(const std::string &path, const std::vector<glm::dvec3> &rays, const std::vector<double> &timestamps)
+{
+  slamio::RayCloudWriter writer;
+  if (!writer.open(path.c_str()))
+  {
+    return false;
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < timestamps.size() && ok; ++i)
+  {
+    ok = writer.addRay(rays[i * 2 + 0], rays[i * 2 + 1], timestamps[i]);
+  }
+  return writer.close() && ok;
+}
+}  // namespace
+
+
+int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoid-c-arrays)
+{
+  cxxopts::Options opt_parse(argv[0], "\nGenerate a synthetic environment with a trajectory and lidar ray cloud, "
+                                      "optionally writing an occupancy map of the environment.\n");
+  opt_parse.positional_help("<scenario>");
+
+  try
+  {
+    // clang-format off
+    opt_parse.add_options()
+      ("help", "Show help.")
+      ("scenario", "The environment type: urban, forest or tunnel.", cxxopts::value(opt->scenario))
+      ("seed", "Random number seed for the environment and sensor noise.", cxxopts::value(opt->params.seed))
+      ("extents", "Environment extents: x,y,z. Z is the maximum feature height. A tunnel uses x for its length.",
+        optVal(opt->params.extents))
+      ("map", "Output occupancy map file (ohm).", cxxopts::value(opt->map_out))
+      ("map-mode", "How to build the --map: 'truth' to voxelise the environment or 'rays' to integrate the generated "
+                   "rays.", optVal(opt->map_mode))
+      ("fill-free", "Write free space as well as occupied voxels in 'truth' mode.", optVal(opt->fill_free))
+      ("resolution", "Map voxel resolution.", optVal(opt->resolution))
+      ("rays", "Output ray cloud file (rcb).", cxxopts::value(opt->rays_out))
+      ("trajectory", "Output trajectory text file (time x y z).", cxxopts::value(opt->trajectory_out))
+      ("no-threads", "Disable multi-threaded generation.", optVal(opt->no_threads))
+      ;
+
+    opt_parse.add_options("Trajectory")
+      ("speed", "Sensor travel speed (m/s).", optVal(opt->speed))
+      ("trajectory-interval", "Time between trajectory samples (s).", optVal(opt->trajectory_interval))
+      ("path-height", "Sensor height above the ground.", optVal(opt->params.path_height))
+      ;
+
+    opt_parse.add_options("Lidar")
+      ("beams", "Number of lidar beams.", optVal(opt->lidar.beam_count))
+      ("azimuth-samples", "Number of lidar columns per revolution.", optVal(opt->lidar.azimuth_samples))
+      ("min-elevation", "Lowest beam elevation (degrees).", optVal(opt->lidar.min_elevation_deg))
+      ("max-elevation", "Highest beam elevation (degrees).", optVal(opt->lidar.max_elevation_deg))
+      ("scan-rate", "Lidar revolutions per second.", optVal(opt->lidar.scan_rate))
+      ("max-range", "Lidar maximum range.", optVal(opt->lidar.max_range))
+      ("range-noise", "Standard deviation of the range noise.", optVal(opt->lidar.range_noise))
+      ("include-misses", "Include rays which do not return, ending at the maximum range.",
+        optVal(opt->lidar.include_misses))
+      ;
+    // clang-format on
+
+    opt_parse.parse_positional({ "scenario" });
+
+    cxxopts::ParseResult parsed = opt_parse.parse(argc, argv);
+
+    if (parsed.count("help") || parsed.arguments().empty())
+    {
+      // show usage.
+      std::cout << opt_parse.help({ "", "Trajectory", "Lidar" }) << std::endl;
+      return 1;
+    }
+
+    if (!ohmgen::parseScenarioType(opt->scenario, &opt->params.type))
+    {
+      std::cerr << "Unknown scenario: " << opt->scenario << std::endl;
+      return -1;
+    }
+
+    if (opt->map_mode != "truth" && opt->map_mode != "rays")
+    {
+      std::cerr << "Unknown map mode: " << opt->map_mode << std::endl;
+      return -1;
+    }
+
+    if (opt->map_out.empty() && opt->rays_out.empty() && opt->trajectory_out.empty())
+    {
+      std::cerr << "No output specified. Use --map, --rays and/or --trajectory." << std::endl;
+      return -1;
+    }
+
+    opt->lidar.seed = opt->params.seed;
+  }
+  catch (const cxxopts::OptionException &e)
+  {
+    std::cerr << "Argument error\n" << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  Options opt;
+
+  std::cout.imbue(std::locale(""));
+
+  int res = parseOptions(&opt, argc, argv);
+  if (res)
+  {
+    return res;
+  }
+
+  const bool use_threads = !opt.no_threads;
+  auto start_time = Clock::now();
+  const ohmgen::Scenario scenario = ohmgen::Scenario::generate(opt.params);
+  std::cout << "Generated " << opt.scenario << " scenario: " << scenario.shapes().size() << " shapes in "
+            << elapsedSeconds(start_time) << "s" << std::endl;
+
+  std::vector<ohmgen::TrajectorySample> trajectory;
+  ohmgen::generateTrajectory(scenario, opt.speed, opt.trajectory_interval, trajectory);
+  std::cout << "Trajectory: " << trajectory.size() << " samples over "
+            << ((!trajectory.empty()) ? trajectory.back().timestamp - trajectory.front().timestamp : 0.0) << "s"
+            << std::endl;
+
+  if (!opt.trajectory_out.empty() && !saveTrajectory(opt.trajectory_out, trajectory))
+  {
+    std::cerr << "Failed to write trajectory " << opt.trajectory_out << std::endl;
+    return -1;
+  }
+
+  std::vector<glm::dvec3> rays;
+  std::vector<double> timestamps;
+  const bool need_rays = !opt.rays_out.empty() || (!opt.map_out.empty() && opt.map_mode == "rays");
+  if (need_rays)
+  {
+    start_time = Clock::now();
+    ohmgen::generateRays(scenario, trajectory, opt.lidar, rays, &timestamps, use_threads);
+    std::cout << "Generated " << timestamps.size() << " rays in " << elapsedSeconds(start_time) << "s" << std::endl;
+  }
+
+  if (!opt.rays_out.empty() && !saveRays(opt.rays_out, rays, timestamps))
+  {
+    std::cerr << "Failed to write rays " << opt.rays_out << std::endl;
+    return -1;
+  }
+
+  if (!opt.map_out.empty())
+  {
+    ohm::OccupancyMap map(opt.resolution);
+    start_time = Clock::now();
+    if (opt.map_mode == "truth")
+    {
+      const size_t occupied = ohmgen::populateMap(map, scenario, opt.fill_free, use_threads);
+      std::cout << "Voxelised " << occupied << " occupied voxels";
+    }
+    else
+    {
+      ohm::RayMapperOccupancy mapper(&map);
+      mapper.setUseThreads(use_threads);
+      mapper.integrateRays(rays.data(), rays.size(), nullptr, timestamps.data(), ohm::kRfDefault);
+      std::cout << "Integrated " << timestamps.size() << " rays";
+    }
+    std::cout << " into " << map.regionCount() << " regions in " << elapsedSeconds(start_time) << "s" << std::endl;
+
+    res = ohm::save(opt.map_out.c_str(), map);
+    if (res)
+    {
+      std::cerr << "Failed to save map. Error(" << res << "): " << ohm::serialiseErrorCodeString(res) << std::endl;
+      return res;
+    }
+  }
+
+  return 0;
+}
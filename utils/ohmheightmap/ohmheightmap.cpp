@@ -9,6 +9,7 @@
 #include <ohm/Voxel.h>
 
 #include <ohmheightmap/Heightmap.h>
+#include <ohmheightmap/HeightmapSerialise.h>
 #include <ohmheightmap/HeightmapVoxel.h>
 
 #include <logutil/LogUtil.h>
@@ -160,6 +161,8 @@ struct Options
   double clearance = 2.0;
   double floor = -1;
   double ceiling = -1;
+  double tile_size = 0;
+  double tile_overlap = 2.0;
   unsigned virtual_surface_filter_threshold = 0;
   bool virtual_surfaces = false;
   bool no_voxel_mean = false;
@@ -217,6 +220,12 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
       ("no-voxel-mean", "Ignore voxel mean positioning if available?.", optVal(opt->no_voxel_mean))  //
       ("seed", "Seed position from which to build the heightmap. Specified as a 3 component vector such as '0,0,1'.",
        optVal(opt->seed_pos))                                                        //
+      ("tile-size",
+       "Generate the heightmap as tiles of this size, saving each tile as '<heightmap>_<a>_<b>.ohm'. Positive to "
+       "enable.",
+       optVal(opt->tile_size))  //
+      ("tile-overlap", "Tile expansion used to generate each tile. Requires '--tile-size'.",
+       optVal(opt->tile_overlap))                                                    //
       ("up", "Specifies the up axis {x,y,z,-x,-y,-z}.", optVal(opt->axis_id))        //
       ("virtual", "Allow virtual surfaces?", cxxopts::value(opt->virtual_surfaces))  //
       ("virtual-filter-threshold",
@@ -340,6 +349,45 @@ int main(int argc, char *argv[])
   heightmap.setGenerateVirtualSurface(opt.virtual_surfaces);
   heightmap.setVirtualSurfaceFilterThreshold(opt.virtual_surface_filter_threshold);
 
+  if (opt.tile_size > 0)
+  {
+    std::string tile_base = opt.heightmap_file;
+    const std::string extension = ".ohm";
+    if (tile_base.size() > extension.size() &&
+        tile_base.compare(tile_base.size() - extension.size(), extension.size(), extension) == 0)
+    {
+      tile_base.resize(tile_base.size() - extension.size());
+    }
+
+    heightmap.setThreadCount(0);
+    unsigned tile_count = 0;
+    const bool ok = heightmap.buildHeightmapTiles(
+      opt.seed_pos, ohm::Aabb(0.0), opt.tile_size, opt.tile_overlap,
+      [&](const ohm::HeightmapTile &tile, ohm::Heightmap &tile_heightmap) {
+        std::ostringstream tile_file;
+        tile_file << tile_base << '_' << tile.index.x << '_' << tile.index.y << extension;
+        const int err = ohm::save(tile_file.str(), tile_heightmap);
+        if (err)
+        {
+          std::cerr << "Failed to save " << tile_file.str() << ". Error(" << err
+                    << "): " << ohm::serialiseErrorCodeString(err) << std::endl;
+          res = err;
+          return false;
+        }
+        ++tile_count;
+        return g_quit == 0;
+      });
+
+    const auto heightmap_end_time = Clock::now();
+    std::cout << "Saved " << tile_count << " tile(s) in " << (heightmap_end_time - heightmap_start_time)
+              << std::endl;
+    if (!ok && !res)
+    {
+      res = -1;
+    }
+    return res;
+  }
+
   heightmap.buildHeightmap(opt.seed_pos);
   heightmap.checkForBaseLayerDuplicates(std::cerr);
 
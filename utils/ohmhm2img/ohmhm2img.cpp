@@ -69,6 +69,7 @@ struct Options
   ExportMode image_mode = kNormals16;
   ohm::HeightmapMesh::NormalsMode normals_mode = ohm::HeightmapMesh::kNormalsAverage;
   double traverse_angle = 45.0;  // NOLINT(readability-magic-numbers)
+  bool cpu = false;
 
   ohm::HeightmapImage::ImageType imageType() const
   {
@@ -398,6 +399,10 @@ int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoi
        "Defines how vertex normals are calculated: [average/avg, worst]. average averages triangle normals, worst "
        "selects the least horizontal triangle normal for a vertex.",
        cxxopts::value(opt->normals_mode)->default_value(optStr(opt->normals_mode)))  //
+      ("cpu",
+       "Render using the CPU rasteriser rather than OpenGL. The CPU rasteriser is used automatically when an OpenGL "
+       "context cannot be created.",
+       cxxopts::value(opt->cpu))  //
       ;
 
     opt_parse.parse_positional({ "i", "o" });
@@ -590,7 +595,8 @@ int main(int argc, char *argv[])
     return res;
   }
 
-  ohm::HeightmapImage hm_image(opt.imageType());
+  ohm::HeightmapImage hm_image(opt.imageType(), 1,
+                              (opt.cpu) ? ohm::HeightmapImage::kBackendCpu : ohm::HeightmapImage::kBackendAuto);
   ohm::HeightmapImage::BitmapInfo info;
   ohm::HeightmapMesh mesh_builder(opt.normals_mode);
 
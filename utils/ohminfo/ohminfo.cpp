@@ -116,6 +116,56 @@ void showMapInfo(const ohm::MapInfo &info)
   std::cout << std::endl;
 }
 
+void showIndexSummary(const std::string &map_file, ohm::OccupancyMap &map)
+{
+  ohm::IndexedMapSummary summary;
+  const int res = ohm::loadIndexSummary(map_file, map, summary);
+  if (res)
+  {
+    std::cerr << "Failed to read region index. Error(" << res << "): " << ohm::serialiseErrorCodeString(res)
+              << std::endl;
+    return;
+  }
+
+  std::cout << std::endl;
+  std::cout << "Region index:" << std::endl;
+  std::cout << "  Regions: " << summary.region_count << std::endl;
+  if (summary.region_count)
+  {
+    std::cout << "  Region key extents: " << summary.min_region << " - " << summary.max_region << std::endl;
+    std::cout << "  Region spatial extents: " << summary.min_ext << " - " << summary.max_ext << std::endl;
+    std::cout << "  Touched time: [" << summary.min_touched_time << "," << summary.max_touched_time << "]"
+              << std::endl;
+  }
+
+  uint64_t total_raw = 0;
+  uint64_t total_stored = 0;
+  for (const ohm::IndexedLayerSummary &layer : summary.layers)
+  {
+    const double ratio = (layer.stored_size) ? double(layer.raw_size) / double(layer.stored_size) : 0.0;
+    std::cout << "  " << layer.name << ": " << logutil::Bytes(layer.stored_size) << " stored, "
+              << logutil::Bytes(layer.raw_size) << " raw, ratio " << std::setprecision(3) << ratio << ", "
+              << layer.compressed_count << " compressed regions" << std::endl;
+    total_raw += layer.raw_size;
+    total_stored += layer.stored_size;
+  }
+  std::cout << "  Total: " << logutil::Bytes(total_stored) << " stored, " << logutil::Bytes(total_raw) << " raw"
+            << std::endl;
+
+  if (!summary.density_histogram.empty())
+  {
+    std::cout << "  Region density (occupancy stored/raw size):" << std::endl;
+    for (size_t i = 0; i < summary.density_histogram.size(); ++i)
+    {
+      std::cout << "    [" << std::setprecision(1) << std::fixed << double(i) / summary.density_histogram.size()
+                << "," << double(i + 1) / summary.density_histogram.size() << ") " << summary.density_histogram[i]
+                << std::endl;
+      std::cout.unsetf(std::ios::floatfield);
+    }
+  }
+  std::cout << std::setprecision(6);
+}
+
 int main(int argc, char *argv[])
 {
   Options opt;
@@ -232,6 +282,12 @@ int main(int argc, char *argv[])
     std::cout << std::setw(0) << std::dec;
   }
 
+  // The indexed format supports region statistics from the index table alone.
+  if (version == ohm::kIndexedVersion)
+  {
+    showIndexSummary(opt.map_file, map);
+  }
+
   // Load full map if required
   if (opt.calculate_extents || opt.detail)
   {
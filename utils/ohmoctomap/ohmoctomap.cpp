@@ -0,0 +1,203 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// Convert between ohm maps and Octomap .bt/.ot files. See ohmtools/OhmOctomap.h
+
+#include <glm/glm.hpp>
+
+#include <ohm/MapSerialise.h>
+#include <ohm/OccupancyMap.h>
+
+#include <ohmtools/OhmOctomap.h>
+
+#include <octomap/AbstractOcTree.h>
+#include <octomap/OcTree.h>
+
+#include <chrono>
+#include <iostream>
+#include <locale>
+#include <memory>
+#include <string>
+
+#include <ohmutil/Options.h>
+
+namespace
+{
+using Clock = std::chrono::high_resolution_clock;
+
+struct Options
+{
+  std::string map_in;
+  std::string map_out;
+  glm::u8vec3 region_dim = glm::u8vec3(32);
+  bool serial = false;
+};
+
+
+bool endsWith(const std::string &str, const std::string &suffix)
+{
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+bool isOctomapFile(const std::string &filename)
+{
+  return endsWith(filename, ".bt") || endsWith(filename, ".ot");
+}
+
+
+double elapsedSeconds(const Clock::time_point &start_time)
+{
+  return std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - start_time).count();
+}
+}  // namespace
+
+
+int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoid-c-arrays)
+{
+  cxxopts::Options opt_parse(argv[0], "\nConvert between ohm maps and Octomap .bt/.ot files. The conversion direction "
+                                      "is selected from the file extensions. Writing .bt files stores only the maximum "
+                                      "likelihood occupancy state of each voxel.\n");
+  opt_parse.positional_help("<map-in> <map-out>");
+
+  try
+  {
+    // clang-format off
+    opt_parse.add_options()
+      ("help", "Show help.")
+      ("i,map", "The input map file (ohm, bt or ot).", cxxopts::value(opt->map_in))
+      ("o,out", "The output map file (ohm, bt or ot).", cxxopts::value(opt->map_out))
+      ("region", "The region voxel dimensions used when creating an ohm map.", optVal(opt->region_dim))
+      ("serial", "Convert without threads?", optVal(opt->serial))
+      ;
+    // clang-format on
+
+    opt_parse.parse_positional({ "map", "out" });
+
+    cxxopts::ParseResult parsed = opt_parse.parse(argc, argv);
+
+    if (parsed.count("help") || parsed.arguments().empty())
+    {
+      // show usage.
+      std::cout << opt_parse.help() << std::endl;
+      return 1;
+    }
+
+    if (opt->map_in.empty())
+    {
+      std::cerr << "Missing input map file name" << std::endl;
+      return -1;
+    }
+
+    if (opt->map_out.empty())
+    {
+      std::cerr << "Missing output map file name" << std::endl;
+      return -1;
+    }
+
+    if (isOctomapFile(opt->map_in) == isOctomapFile(opt->map_out))
+    {
+      std::cerr << "Exactly one of the input and output files must be an Octomap file (.bt or .ot)" << std::endl;
+      return -1;
+    }
+  }
+  catch (const cxxopts::OptionException &e)
+  {
+    std::cerr << "Argument error\n" << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+int ohmToOctomap(const Options &opt)
+{
+  ohm::OccupancyMap map(1.0f);
+  std::cout << "Loading " << opt.map_in << std::endl;
+  int res = ohm::load(opt.map_in.c_str(), map);
+  if (res != 0)
+  {
+    std::cerr << "Failed to load map. Error(" << res << "): " << ohm::serialiseErrorCodeString(res) << std::endl;
+    return res;
+  }
+
+  const auto start_time = Clock::now();
+  octomap::OcTree tree(map.resolution());
+  const size_t voxel_count = ohmtools::exportOctomap(map, tree, !opt.serial);
+  std::cout << "Converted " << voxel_count << " voxels to " << tree.size() << " nodes in "
+            << elapsedSeconds(start_time) << "s" << std::endl;
+
+  std::cout << "Saving " << opt.map_out << std::endl;
+  const bool ok = (endsWith(opt.map_out, ".bt")) ? tree.writeBinary(opt.map_out) : tree.write(opt.map_out);
+  if (!ok)
+  {
+    std::cerr << "Failed to save " << opt.map_out << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+int octomapToOhm(const Options &opt)
+{
+  std::cout << "Loading " << opt.map_in << std::endl;
+  std::unique_ptr<octomap::OcTree> tree;
+  if (endsWith(opt.map_in, ".bt"))
+  {
+    tree = std::make_unique<octomap::OcTree>(0.1);
+    if (!tree->readBinary(opt.map_in))
+    {
+      tree.reset();
+    }
+  }
+  else
+  {
+    std::unique_ptr<octomap::AbstractOcTree> abstract_tree(octomap::AbstractOcTree::read(opt.map_in));
+    if (dynamic_cast<octomap::OcTree *>(abstract_tree.get()))
+    {
+      tree.reset(static_cast<octomap::OcTree *>(abstract_tree.release()));
+    }
+  }
+
+  if (!tree)
+  {
+    std::cerr << "Failed to load Octomap tree from " << opt.map_in << std::endl;
+    return -1;
+  }
+
+  const auto start_time = Clock::now();
+  ohm::OccupancyMap map(tree->getResolution(), opt.region_dim);
+  const size_t voxel_count = ohmtools::importOctomap(map, *tree, !opt.serial);
+  std::cout << "Converted " << tree->getNumLeafNodes() << " leaves to " << voxel_count << " voxels in "
+            << elapsedSeconds(start_time) << "s" << std::endl;
+
+  std::cout << "Saving " << opt.map_out << std::endl;
+  const int res = ohm::save(opt.map_out.c_str(), map);
+  if (res != 0)
+  {
+    std::cerr << "Failed to save map. Error(" << res << "): " << ohm::serialiseErrorCodeString(res) << std::endl;
+  }
+
+  return res;
+}
+
+
+int main(int argc, char *argv[])
+{
+  Options opt;
+
+  std::cout.imbue(std::locale(""));
+
+  int res = parseOptions(&opt, argc, argv);
+  if (res)
+  {
+    return res;
+  }
+
+  return (isOctomapFile(opt.map_in)) ? octomapToOhm(opt) : ohmToOctomap(opt);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "BlobCache.h"
+
+namespace ohmserve
+{
+namespace
+{
+/// Limit on the number of blobs with tracked request counts.
+const size_t kMaxMissCounts = size_t(1u) << 16u;
+}  // namespace
+
+BlobCache::BlobCache(size_t capacity, unsigned promote_hits)
+  : capacity_(capacity)
+  , promote_hits_(promote_hits)
+{}
+
+
+BlobCache::Blob BlobCache::find(const Key &key)
+{
+  const auto iter = lookup_.find(key);
+  if (iter == lookup_.end())
+  {
+    ++misses_;
+    return nullptr;
+  }
+
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, iter->second);
+  return iter->second->blob;
+}
+
+
+bool BlobCache::recordMiss(const Key &key, size_t blob_size)
+{
+  if (blob_size == 0 || blob_size > capacity_)
+  {
+    return false;
+  }
+
+  if (promote_hits_ <= 1u)
+  {
+    return true;
+  }
+
+  if (miss_counts_.size() >= kMaxMissCounts)
+  {
+    miss_counts_.clear();
+  }
+
+  unsigned &count = miss_counts_[key];
+  if (++count < promote_hits_)
+  {
+    return false;
+  }
+
+  miss_counts_.erase(key);
+  return true;
+}
+
+
+void BlobCache::insert(const Key &key, Blob blob)
+{
+  if (!blob || blob->size() > capacity_)
+  {
+    return;
+  }
+
+  const auto existing = lookup_.find(key);
+  if (existing != lookup_.end())
+  {
+    bytes_ -= existing->second->blob->size();
+    entries_.erase(existing->second);
+    lookup_.erase(existing);
+  }
+
+  while (!entries_.empty() && bytes_ + blob->size() > capacity_)
+  {
+    const Entry &lru = entries_.back();
+    bytes_ -= lru.blob->size();
+    lookup_.erase(lru.key);
+    entries_.pop_back();
+    ++evictions_;
+  }
+
+  bytes_ += blob->size();
+  entries_.emplace_front(Entry{ key, std::move(blob) });
+  lookup_.emplace(key, entries_.begin());
+}
+
+
+void BlobCache::clear()
+{
+  entries_.clear();
+  lookup_.clear();
+  miss_counts_.clear();
+  bytes_ = 0;
+}
+}  // namespace ohmserve
@@ -0,0 +1,123 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMSERVE_BLOBCACHE_H
+#define OHMSERVE_BLOBCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace ohmserve
+{
+/// A least recently used cache of the region layer blobs served by the @c TileServer , bounded by byte size.
+///
+/// Blobs are held as stored in the map file - usually compressed - so the cache holds many more regions than would
+/// fit decoded. Blobs are only promoted into the cache once they have been requested @c promoteHits() times, so that
+/// a scan over cold regions does not evict the hot regions. Cold requests are served directly from the file instead.
+///
+/// The cache is not thread safe.
+class BlobCache
+{
+public:
+  /// Blob data. Shared so that a blob evicted while being sent remains valid until the send completes.
+  using Blob = std::shared_ptr<const std::vector<uint8_t>>;
+
+  /// Identifies a blob by map, region and layer indices.
+  struct Key
+  {
+    uint32_t map;     ///< Map index.
+    uint32_t region;  ///< Region index in the map's region index.
+    uint32_t layer;   ///< Stored layer index.
+
+    inline bool operator==(const Key &other) const
+    {
+      return map == other.map && region == other.region && layer == other.layer;
+    }
+  };
+
+  /// Hash for a @c Key .
+  struct KeyHash
+  {
+    inline size_t operator()(const Key &key) const
+    {
+      return (size_t(key.region) * 0x9e3779b1u) ^ (size_t(key.map) << 24u) ^ size_t(key.layer);
+    }
+  };
+
+  /// Constructor.
+  /// @param capacity The maximum total blob byte size. Zero disables caching.
+  /// @param promote_hits The number of requests for a blob before it is cached. Zero or one caches on first request.
+  BlobCache(size_t capacity, unsigned promote_hits);
+
+  /// Query the maximum total blob byte size.
+  /// @return The byte capacity.
+  inline size_t capacity() const { return capacity_; }
+  /// Query the number of requests for a blob before it is cached.
+  /// @return The promotion threshold.
+  inline unsigned promoteHits() const { return promote_hits_; }
+
+  /// Query the total byte size of the cached blobs.
+  /// @return The cached byte size.
+  inline size_t bytes() const { return bytes_; }
+  /// Query the number of cached blobs.
+  /// @return The cached blob count.
+  inline size_t size() const { return lookup_.size(); }
+  /// Query the number of @c find() calls which found a blob.
+  /// @return The hit count.
+  inline uint64_t hits() const { return hits_; }
+  /// Query the number of @c find() calls which did not find a blob.
+  /// @return The miss count.
+  inline uint64_t misses() const { return misses_; }
+  /// Query the number of blobs evicted to make room for others.
+  /// @return The eviction count.
+  inline uint64_t evictions() const { return evictions_; }
+
+  /// Find the blob for @p key , marking it as most recently used.
+  /// @param key The blob key.
+  /// @return The blob, or null if not cached.
+  Blob find(const Key &key);
+
+  /// Record a request for @p key which missed the cache.
+  /// @param key The blob key.
+  /// @param blob_size The blob byte size.
+  /// @return True if the blob should now be loaded and added with @c insert() .
+  bool recordMiss(const Key &key, size_t blob_size);
+
+  /// Add @p blob for @p key as the most recently used blob, evicting least recently used blobs as required.
+  /// @param key The blob key.
+  /// @param blob The blob data.
+  void insert(const Key &key, Blob blob);
+
+  /// Remove all blobs and request counts.
+  void clear();
+
+private:
+  struct Entry
+  {
+    Key key;
+    Blob blob;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  size_t capacity_ = 0;
+  size_t bytes_ = 0;
+  unsigned promote_hits_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+  /// Blobs in most recently used order.
+  EntryList entries_;
+  std::unordered_map<Key, EntryList::iterator, KeyHash> lookup_;
+  /// Request counts for blobs not yet promoted. Cleared when it grows too large, which only delays promotion.
+  std::unordered_map<Key, unsigned, KeyHash> miss_counts_;
+};
+}  // namespace ohmserve
+
+#endif  // OHMSERVE_BLOBCACHE_H
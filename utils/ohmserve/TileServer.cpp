@@ -0,0 +1,1176 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#include "TileServer.h"
+
+#include <ohm/MapLayer.h>
+#include <ohm/MapLayout.h>
+#include <ohm/MapRegion.h>
+#include <ohm/MapSerialise.h>
+#include <ohm/OccupancyMap.h>
+
+#include <logutil/LogUtil.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif  // __linux__
+
+namespace ohmserve
+{
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+/// Poll timeout, bounding the latency of responding to the quit flag.
+const int kPollTimeoutMs = 200;
+/// Maximum byte size of a request line and headers.
+const size_t kMaxRequestBytes = 16u * 1024u;
+/// Byte size of reads from a socket, and of file reads where @c sendfile() is not available.
+const size_t kIoChunk = 64u * 1024u;
+/// Listen backlog.
+const int kListenBacklog = 128;
+
+#ifdef MSG_NOSIGNAL
+const int kSendFlags = MSG_NOSIGNAL;
+#else   // MSG_NOSIGNAL
+const int kSendFlags = 0;
+#endif  // MSG_NOSIGNAL
+
+/// A registered map file.
+struct MapEntry
+{
+  std::string name;
+  std::string path;
+  int fd = -1;
+  uint64_t file_size = 0;
+  /// Entity tag for the file content and the JSON derived from it.
+  std::string etag;
+  ohm::IndexedRegionIndex index;
+  std::unordered_map<glm::i16vec3, uint32_t, ohm::MapRegion::Hash> region_lookup;
+  std::string info_json;
+  std::string index_json;
+};
+
+/// A response body: inline text, a cached blob or a file byte range.
+struct Body
+{
+  std::string text;
+  BlobCache::Blob blob;
+  int fd = -1;
+  /// Byte offset into @c blob or the file.
+  uint64_t offset = 0;
+  /// Byte length for @c blob or file bodies.
+  uint64_t length = 0;
+
+  inline bool isText() const { return !blob && fd < 0; }
+  inline uint64_t size() const { return isText() ? text.size() : length; }
+};
+
+/// A parsed request. Header names are lower case.
+struct Request
+{
+  std::string method;
+  std::string target;
+  std::string version;
+  std::unordered_map<std::string, std::string> headers;
+  bool keep_alive = true;
+  bool has_body = false;
+
+  const std::string &header(const std::string &name) const
+  {
+    static const std::string empty;
+    const auto iter = headers.find(name);
+    return (iter != headers.end()) ? iter->second : empty;
+  }
+};
+
+/// A client connection and its outgoing response state.
+struct Connection
+{
+  int fd = -1;
+  /// Received bytes not yet parsed as requests.
+  std::string in;
+  /// Response headers and any inline body to send.
+  std::string out;
+  size_t out_pos = 0;
+  /// Cached blob body to send after @c out .
+  BlobCache::Blob blob;
+  uint64_t blob_pos = 0;
+  uint64_t blob_end = 0;
+  /// File body to send after @c out .
+  int file_fd = -1;
+  uint64_t file_pos = 0;
+  uint64_t file_end = 0;
+  /// Close once the current response is sent.
+  bool close_after = false;
+  /// The client has closed its end for writing.
+  bool read_closed = false;
+  Clock::time_point last_active;
+
+  inline bool sending() const { return out_pos < out.size() || blob_pos < blob_end || file_pos < file_end; }
+};
+
+/// Result of @c flush() .
+enum class FlushResult
+{
+  kDone,
+  kBlocked,
+  kError
+};
+
+std::string toLower(std::string str)
+{
+  std::transform(str.begin(), str.end(), str.begin(), [](char c) { return char(std::tolower(int(c))); });
+  return str;
+}
+
+std::string trim(const std::string &str)
+{
+  const size_t begin = str.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+  {
+    return std::string();
+  }
+  const size_t end = str.find_last_not_of(" \t");
+  return str.substr(begin, end - begin + 1);
+}
+
+void jsonString(std::ostream &out, const std::string &str)
+{
+  out << '"';
+  for (char c : str)
+  {
+    switch (c)
+    {
+    case '"':
+      out << "\\\"";
+      break;
+    case '\\':
+      out << "\\\\";
+      break;
+    default:
+      if (uint8_t(c) < 0x20u)
+      {
+        out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << unsigned(uint8_t(c)) << std::dec;
+      }
+      else
+      {
+        out << c;
+      }
+      break;
+    }
+  }
+  out << '"';
+}
+
+const char *encodingName(uint32_t encoding)
+{
+  switch (encoding)
+  {
+  case ohm::kIbeRaw:
+    return "raw";
+  case ohm::kIbeZLib:
+    return "zlib";
+  case ohm::kIbeSparse:
+    return "sparse";
+  default:
+    break;
+  }
+  return "unknown";
+}
+
+const char *statusText(int status)
+{
+  switch (status)
+  {
+  case 200:  // NOLINT(readability-magic-numbers)
+    return "OK";
+  case 206:  // NOLINT(readability-magic-numbers)
+    return "Partial Content";
+  case 304:  // NOLINT(readability-magic-numbers)
+    return "Not Modified";
+  case 400:  // NOLINT(readability-magic-numbers)
+    return "Bad Request";
+  case 404:  // NOLINT(readability-magic-numbers)
+    return "Not Found";
+  case 405:  // NOLINT(readability-magic-numbers)
+    return "Method Not Allowed";
+  case 416:  // NOLINT(readability-magic-numbers)
+    return "Range Not Satisfiable";
+  case 431:  // NOLINT(readability-magic-numbers)
+    return "Request Header Fields Too Large";
+  default:
+    break;
+  }
+  return "Internal Server Error";
+}
+
+/// Split a path into its non empty segments, ignoring any query string.
+std::vector<std::string> splitPath(const std::string &target)
+{
+  std::vector<std::string> segments;
+  const size_t end = std::min(target.find('?'), target.size());
+  size_t begin = 0;
+  while (begin < end)
+  {
+    const size_t next = std::min(target.find('/', begin), end);
+    if (next > begin)
+    {
+      segments.emplace_back(target.substr(begin, next - begin));
+    }
+    begin = next + 1;
+  }
+  return segments;
+}
+
+bool parseInt(const std::string &str, long min_value, long max_value, long *value)
+{
+  if (str.empty())
+  {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  const long parsed = std::strtol(str.c_str(), &end, 10);  // NOLINT(readability-magic-numbers)
+  if (errno || *end != '\0' || parsed < min_value || parsed > max_value)
+  {
+    return false;
+  }
+  *value = parsed;
+  return true;
+}
+
+/// Parse a request line and headers, excluding the terminating blank line.
+bool parseRequest(const std::string &text, Request *request)
+{
+  std::istringstream in(text);
+  std::string line;
+  if (!std::getline(in, line))
+  {
+    return false;
+  }
+  if (!line.empty() && line.back() == '\r')
+  {
+    line.pop_back();
+  }
+
+  std::istringstream request_line(line);
+  if (!(request_line >> request->method >> request->target >> request->version) ||
+      request->version.compare(0, 5, "HTTP/") != 0 || request->target.empty() || request->target[0] != '/')
+  {
+    return false;
+  }
+
+  while (std::getline(in, line))
+  {
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.pop_back();
+    }
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos || colon == 0)
+    {
+      return false;
+    }
+    request->headers[toLower(line.substr(0, colon))] = trim(line.substr(colon + 1));
+  }
+
+  const std::string connection = toLower(request->header("connection"));
+  request->keep_alive = (request->version == "HTTP/1.0") ? connection.find("keep-alive") != std::string::npos :
+                                                           connection.find("close") == std::string::npos;
+  const std::string &content_length = request->header("content-length");
+  request->has_body =
+    !request->header("transfer-encoding").empty() || (!content_length.empty() && content_length != "0");
+  return true;
+}
+
+/// Check an @c If-None-Match header value against @p etag .
+bool etagMatches(const std::string &header, const std::string &etag)
+{
+  size_t begin = 0;
+  while (begin <= header.size())
+  {
+    const size_t end = std::min(header.find(',', begin), header.size());
+    std::string tag = trim(header.substr(begin, end - begin));
+    if (tag.compare(0, 2, "W/") == 0)
+    {
+      tag.erase(0, 2);
+    }
+    if (tag == "*" || tag == etag)
+    {
+      return true;
+    }
+    begin = end + 1;
+  }
+  return false;
+}
+
+/// Result of @c parseRange() .
+enum class RangeResult
+{
+  /// No usable range: send the whole body.
+  kNone,
+  kSatisfiable,
+  kUnsatisfiable
+};
+
+/// Parse a single `bytes=` range of a body of @p size bytes. Multiple ranges are not supported and are ignored, as
+/// is any malformed range.
+RangeResult parseRange(const std::string &header, uint64_t size, uint64_t *begin, uint64_t *end)
+{
+  const std::string prefix = "bytes=";
+  if (header.compare(0, prefix.size(), prefix) != 0 || header.find(',') != std::string::npos)
+  {
+    return RangeResult::kNone;
+  }
+
+  const std::string spec = trim(header.substr(prefix.size()));
+  const size_t dash = spec.find('-');
+  if (dash == std::string::npos)
+  {
+    return RangeResult::kNone;
+  }
+
+  const std::string first = spec.substr(0, dash);
+  const std::string last = spec.substr(dash + 1);
+  char *parse_end = nullptr;
+  if (first.empty())
+  {
+    // Suffix range: the final bytes.
+    const unsigned long long suffix = std::strtoull(last.c_str(), &parse_end, 10);  // NOLINT
+    if (last.empty() || *parse_end != '\0')
+    {
+      return RangeResult::kNone;
+    }
+    if (suffix == 0 || size == 0)
+    {
+      return RangeResult::kUnsatisfiable;
+    }
+    *begin = size - std::min<uint64_t>(suffix, size);
+    *end = size;
+    return RangeResult::kSatisfiable;
+  }
+
+  const unsigned long long first_byte = std::strtoull(first.c_str(), &parse_end, 10);  // NOLINT
+  if (*parse_end != '\0')
+  {
+    return RangeResult::kNone;
+  }
+  unsigned long long last_byte = std::numeric_limits<unsigned long long>::max();
+  if (!last.empty())
+  {
+    last_byte = std::strtoull(last.c_str(), &parse_end, 10);  // NOLINT
+    if (*parse_end != '\0' || last_byte < first_byte)
+    {
+      return RangeResult::kNone;
+    }
+  }
+
+  if (first_byte >= size)
+  {
+    return RangeResult::kUnsatisfiable;
+  }
+
+  *begin = first_byte;
+  *end = std::min<uint64_t>(last_byte, size - 1) + 1;
+  return RangeResult::kSatisfiable;
+}
+
+void closeFd(int &fd)
+{
+  if (fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool setNonBlocking(int fd)
+{
+  const int flags = ::fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+}  // namespace
+
+
+struct TileServer::Detail
+{
+  TileServerOptions options;
+  BlobCache cache;
+  std::vector<std::unique_ptr<MapEntry>> maps;
+  std::unordered_map<std::string, uint32_t> map_lookup;
+  std::vector<std::unique_ptr<Connection>> connections;
+  std::vector<uint8_t> scratch;
+  int listen_fd = -1;
+  uint16_t port = 0;
+  uint64_t accepted = 0;
+  uint64_t requests = 0;
+  uint64_t bytes_sent = 0;
+
+  explicit Detail(const TileServerOptions &options)
+    : options(options)
+    , cache(options.cache_bytes, options.promote_hits)
+  {}
+
+  void accept(Clock::time_point now);
+  bool receive(Connection &connection);
+  bool pump(Connection &connection);
+  FlushResult flush(Connection &connection);
+  void handle(Connection &connection, const Request &request);
+  void respond(Connection &connection, const Request &request, int status, Body body,
+               const std::string &content_type, const std::string &etag = std::string(),
+               const std::string &extra_headers = std::string());
+  void respondError(Connection &connection, const Request &request, int status,
+                    const std::string &extra_headers = std::string());
+  void serveRegion(Connection &connection, const Request &request, uint32_t map_index,
+                   const std::vector<std::string> &segments);
+  std::string mapsJson() const;
+  std::string statsJson() const;
+};
+
+
+void TileServer::Detail::accept(Clock::time_point now)
+{
+  while (connections.size() < options.max_clients)
+  {
+    const int fd = ::accept(listen_fd, nullptr, nullptr);
+    if (fd < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      {
+        logutil::warn("accept failed: ", std::strerror(errno), '\n');
+      }
+      return;
+    }
+
+    if (!setNonBlocking(fd))
+    {
+      ::close(fd);
+      continue;
+    }
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int no_delay = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    std::unique_ptr<Connection> connection(new Connection);
+    connection->fd = fd;
+    connection->last_active = now;
+    connections.emplace_back(std::move(connection));
+    ++accepted;
+  }
+}
+
+
+bool TileServer::Detail::receive(Connection &connection)
+{
+  char buffer[kIoChunk];  // NOLINT(modernize-avoid-c-arrays)
+  for (;;)
+  {
+    const ssize_t read = ::recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (read > 0)
+    {
+      connection.in.append(buffer, size_t(read));
+      if (connection.in.size() > kMaxRequestBytes * 4u)
+      {
+        // Pipelining far ahead of the responses. Stop reading until the backlog is processed.
+        break;
+      }
+      continue;
+    }
+    if (read == 0)
+    {
+      connection.read_closed = true;
+      break;
+    }
+    if (errno == EINTR)
+    {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+    {
+      break;
+    }
+    return false;
+  }
+
+  return pump(connection);
+}
+
+
+bool TileServer::Detail::pump(Connection &connection)
+{
+  for (;;)
+  {
+    if (connection.sending())
+    {
+      const FlushResult result = flush(connection);
+      if (result != FlushResult::kDone)
+      {
+        return result == FlushResult::kBlocked;
+      }
+    }
+
+    if (connection.close_after)
+    {
+      return false;
+    }
+
+    const size_t header_end = connection.in.find("\r\n\r\n");
+    if (header_end == std::string::npos)
+    {
+      if (connection.in.size() > kMaxRequestBytes)
+      {
+        connection.in.clear();
+        Request request;
+        request.keep_alive = false;
+        respondError(connection, request, 431);  // NOLINT(readability-magic-numbers)
+        continue;
+      }
+      // Wait for more data unless the client has finished sending.
+      return !connection.read_closed;
+    }
+
+    Request request;
+    const bool parsed = parseRequest(connection.in.substr(0, header_end), &request);
+    connection.in.erase(0, header_end + 4);
+    ++requests;
+
+    if (!parsed)
+    {
+      request.keep_alive = false;
+      respondError(connection, request, 400);  // NOLINT(readability-magic-numbers)
+      continue;
+    }
+
+    // Request bodies are not supported, so the stream cannot be resynchronised after one.
+    request.keep_alive = request.keep_alive && !request.has_body;
+    handle(connection, request);
+  }
+}
+
+
+FlushResult TileServer::Detail::flush(Connection &connection)
+{
+  while (connection.out_pos < connection.out.size())
+  {
+    const ssize_t sent = ::send(connection.fd, connection.out.data() + connection.out_pos,
+                                connection.out.size() - connection.out_pos, kSendFlags);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::kBlocked : FlushResult::kError;
+    }
+    connection.out_pos += size_t(sent);
+    bytes_sent += uint64_t(sent);
+  }
+  connection.out.clear();
+  connection.out_pos = 0;
+
+  while (connection.blob_pos < connection.blob_end)
+  {
+    const ssize_t sent = ::send(connection.fd, connection.blob->data() + connection.blob_pos,
+                                size_t(connection.blob_end - connection.blob_pos), kSendFlags);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::kBlocked : FlushResult::kError;
+    }
+    connection.blob_pos += uint64_t(sent);
+    bytes_sent += uint64_t(sent);
+  }
+  connection.blob.reset();
+
+  while (connection.file_pos < connection.file_end)
+  {
+    const size_t count = size_t(std::min<uint64_t>(connection.file_end - connection.file_pos, kIoChunk * 16u));
+#ifdef __linux__
+    off_t offset = off_t(connection.file_pos);
+    const ssize_t sent = ::sendfile(connection.fd, connection.file_fd, &offset, count);
+#else   // __linux__
+    // Read a chunk and send what the socket accepts. Any unsent remainder is read again on the next flush.
+    scratch.resize(kIoChunk);
+    const ssize_t read =
+      ::pread(connection.file_fd, scratch.data(), std::min(count, scratch.size()), off_t(connection.file_pos));
+    if (read < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (read <= 0)
+    {
+      return FlushResult::kError;
+    }
+    const ssize_t sent = ::send(connection.fd, scratch.data(), size_t(read), kSendFlags);
+#endif  // __linux__
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return (errno == EAGAIN || errno == EWOULDBLOCK) ? FlushResult::kBlocked : FlushResult::kError;
+    }
+    if (sent == 0)
+    {
+      // The file is shorter than indexed.
+      return FlushResult::kError;
+    }
+    connection.file_pos += uint64_t(sent);
+    bytes_sent += uint64_t(sent);
+  }
+  connection.file_fd = -1;
+
+  return FlushResult::kDone;
+}
+
+
+void TileServer::Detail::handle(Connection &connection, const Request &request)
+{
+  if (request.method != "GET" && request.method != "HEAD")
+  {
+    respondError(connection, request, 405, "Allow: GET, HEAD\r\n");  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  const std::vector<std::string> segments = splitPath(request.target);
+  if (segments.empty() || (segments.size() == 1 && segments[0] == "maps"))
+  {
+    Body body;
+    body.text = mapsJson();
+    respond(connection, request, 200, body, "application/json");  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  if (segments.size() == 1 && segments[0] == "stats")
+  {
+    Body body;
+    body.text = statsJson();
+    respond(connection, request, 200, body, "application/json");  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  const auto map_iter = (segments.size() >= 2) ? map_lookup.find(segments[0]) : map_lookup.end();
+  if (map_iter == map_lookup.end())
+  {
+    respondError(connection, request, 404);  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  const MapEntry &map = *maps[map_iter->second];
+  const std::string &resource = segments[1];
+  Body body;
+  if (segments.size() == 2 && (resource == "info" || resource == "index"))
+  {
+    body.text = (resource == "info") ? map.info_json : map.index_json;
+    respond(connection, request, 200, body, "application/json", map.etag);  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  if (segments.size() == 2 && (resource == "header" || resource == "file"))
+  {
+    body.fd = map.fd;
+    body.length = (resource == "header") ? map.index.header_size : map.file_size;
+    respond(connection, request, 200, body, "application/octet-stream", map.etag);  // NOLINT
+    return;
+  }
+
+  if (resource == "region")
+  {
+    serveRegion(connection, request, map_iter->second, segments);
+    return;
+  }
+
+  respondError(connection, request, 404);  // NOLINT(readability-magic-numbers)
+}
+
+
+void TileServer::Detail::serveRegion(Connection &connection, const Request &request, uint32_t map_index,
+                                     const std::vector<std::string> &segments)
+{
+  const MapEntry &map = *maps[map_index];
+  const size_t region_path_segments = 6;
+  if (segments.size() != region_path_segments)
+  {
+    respondError(connection, request, 404);  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  long coord[3] = { 0, 0, 0 };  // NOLINT(modernize-avoid-c-arrays)
+  for (int i = 0; i < 3; ++i)
+  {
+    if (!parseInt(segments[2 + i], std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max(),
+                  &coord[i]))
+    {
+      respondError(connection, request, 400);  // NOLINT(readability-magic-numbers)
+      return;
+    }
+  }
+
+  // The layer may be given by stored layer index or by name.
+  long layer = -1;
+  if (!parseInt(segments[5], 0, long(map.index.layers.size()) - 1, &layer))
+  {
+    const auto layer_iter = std::find(map.index.layers.begin(), map.index.layers.end(), segments[5]);
+    layer = (layer_iter != map.index.layers.end()) ? long(layer_iter - map.index.layers.begin()) : -1;
+  }
+
+  const auto region_iter = map.region_lookup.find(glm::i16vec3(coord[0], coord[1], coord[2]));
+  if (layer < 0 || region_iter == map.region_lookup.end())
+  {
+    respondError(connection, request, 404);  // NOLINT(readability-magic-numbers)
+    return;
+  }
+
+  const ohm::IndexedLayerBlob &blob = map.index.blob(region_iter->second, size_t(layer));
+  std::ostringstream etag;
+  etag << "\"r" << blob.touched_stamp << '-' << blob.offset << '-' << blob.stored_size << '"';
+  std::ostringstream headers;
+  headers << "X-Ohm-Encoding: " << encodingName(blob.encoding) << "\r\n";
+  headers << "X-Ohm-Layer-Stamp: " << blob.touched_stamp << "\r\n";
+
+  Body body;
+  body.length = blob.stored_size;
+  if (request.method == "GET")
+  {
+    const BlobCache::Key key{ map_index, region_iter->second, uint32_t(layer) };
+    body.blob = cache.find(key);
+    if (!body.blob && cache.recordMiss(key, size_t(blob.stored_size)))
+    {
+      std::shared_ptr<std::vector<uint8_t>> data = std::make_shared<std::vector<uint8_t>>(blob.stored_size);
+      const ssize_t read = ::pread(map.fd, data->data(), data->size(), off_t(blob.offset));
+      if (read == ssize_t(data->size()))
+      {
+        body.blob = data;
+        cache.insert(key, body.blob);
+      }
+    }
+  }
+
+  if (!body.blob)
+  {
+    body.fd = map.fd;
+    body.offset = blob.offset;
+  }
+
+  respond(connection, request, 200, body, "application/octet-stream", etag.str(),  // NOLINT
+          headers.str());
+}
+
+
+void TileServer::Detail::respond(Connection &connection, const Request &request, int status, Body body,
+                                 const std::string &content_type, const std::string &etag,
+                                 const std::string &extra_headers)
+{
+  std::ostringstream headers;
+  if (!etag.empty())
+  {
+    headers << "ETag: " << etag << "\r\n";
+    headers << "Cache-Control: no-cache\r\n";
+
+    if (etagMatches(request.header("if-none-match"), etag))
+    {
+      status = 304;  // NOLINT(readability-magic-numbers)
+      body = Body();
+    }
+  }
+
+  if (status == 200 && !etag.empty())  // NOLINT(readability-magic-numbers)
+  {
+    headers << "Accept-Ranges: bytes\r\n";
+    const std::string &range = request.header("range");
+    const std::string &if_range = request.header("if-range");
+    if (!range.empty() && (if_range.empty() || if_range == etag))
+    {
+      uint64_t begin = 0;
+      uint64_t end = 0;
+      const uint64_t size = body.size();
+      switch (parseRange(range, size, &begin, &end))
+      {
+      case RangeResult::kSatisfiable:
+        status = 206;  // NOLINT(readability-magic-numbers)
+        headers << "Content-Range: bytes " << begin << '-' << end - 1 << '/' << size << "\r\n";
+        if (body.isText())
+        {
+          body.text = body.text.substr(size_t(begin), size_t(end - begin));
+        }
+        else
+        {
+          body.offset += begin;
+          body.length = end - begin;
+        }
+        break;
+      case RangeResult::kUnsatisfiable:
+        status = 416;  // NOLINT(readability-magic-numbers)
+        headers << "Content-Range: bytes */" << size << "\r\n";
+        body = Body();
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+  connection.close_after = !request.keep_alive;
+
+  std::ostringstream out;
+  out << "HTTP/1.1 " << status << ' ' << statusText(status) << "\r\n";
+  out << "Server: ohmserve\r\n";
+  if (status != 304)  // NOLINT(readability-magic-numbers)
+  {
+    out << "Content-Type: " << content_type << "\r\n";
+    out << "Content-Length: " << body.size() << "\r\n";
+  }
+  out << headers.str() << extra_headers;
+  out << "Connection: " << (connection.close_after ? "close" : "keep-alive") << "\r\n\r\n";
+
+  connection.out += out.str();
+  if (request.method == "HEAD")
+  {
+    return;
+  }
+
+  if (body.isText())
+  {
+    connection.out += body.text;
+  }
+  else if (body.blob)
+  {
+    connection.blob = body.blob;
+    connection.blob_pos = body.offset;
+    connection.blob_end = body.offset + body.length;
+  }
+  else
+  {
+    connection.file_fd = body.fd;
+    connection.file_pos = body.offset;
+    connection.file_end = body.offset + body.length;
+  }
+}
+
+
+void TileServer::Detail::respondError(Connection &connection, const Request &request, int status,
+                                      const std::string &extra_headers)
+{
+  Body body;
+  body.text = std::string(statusText(status)) + "\n";
+  respond(connection, request, status, body, "text/plain", std::string(), extra_headers);
+}
+
+
+std::string TileServer::Detail::mapsJson() const
+{
+  std::ostringstream out;
+  out << "{\"maps\":[";
+  for (size_t i = 0; i < maps.size(); ++i)
+  {
+    out << (i ? "," : "");
+    jsonString(out, maps[i]->name);
+  }
+  out << "]}\n";
+  return out.str();
+}
+
+
+std::string TileServer::Detail::statsJson() const
+{
+  std::ostringstream out;
+  out << "{\"maps\":" << maps.size() << ",\"connections\":" << connections.size() << ",\"accepted\":" << accepted
+      << ",\"requests\":" << requests << ",\"bytes_sent\":" << bytes_sent;
+  out << ",\"cache\":{\"capacity\":" << cache.capacity() << ",\"bytes\":" << cache.bytes()
+      << ",\"blobs\":" << cache.size() << ",\"hits\":" << cache.hits() << ",\"misses\":" << cache.misses()
+      << ",\"evictions\":" << cache.evictions() << ",\"promote_hits\":" << cache.promoteHits() << "}}\n";
+  return out.str();
+}
+
+
+TileServer::TileServer(const TileServerOptions &options)
+  : imp_(new Detail(options))
+{}
+
+
+TileServer::~TileServer()
+{
+  for (auto &connection : imp_->connections)
+  {
+    closeFd(connection->fd);
+  }
+  for (auto &map : imp_->maps)
+  {
+    closeFd(map->fd);
+  }
+  closeFd(imp_->listen_fd);
+}
+
+
+bool TileServer::addMap(const std::string &name, const std::string &path)
+{
+  if (name.empty() || name.find('/') != std::string::npos || name.find('?') != std::string::npos)
+  {
+    logutil::error("Invalid map name '", name, "'\n");
+    return false;
+  }
+
+  if (imp_->map_lookup.find(name) != imp_->map_lookup.end())
+  {
+    logutil::error("Duplicate map name '", name, "'\n");
+    return false;
+  }
+
+  std::unique_ptr<MapEntry> entry(new MapEntry);
+  entry->name = name;
+  entry->path = path;
+
+  ohm::OccupancyMap map(1.0);
+  ohm::MapVersion version;
+  const int err = ohm::loadRegionIndex(path, map, entry->index, &version);
+  if (err)
+  {
+    if (err == ohm::kSeUnsupportedVersion)
+    {
+      logutil::error("Map '", path, "' is not an indexed map. Convert it using ohmupgrade.\n");
+    }
+    else
+    {
+      logutil::error("Failed to load map index '", path, "': ", ohm::serialiseErrorCodeString(err), '\n');
+    }
+    return false;
+  }
+
+  entry->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat file_stat = {};
+  if (entry->fd < 0 || ::fstat(entry->fd, &file_stat) != 0)
+  {
+    logutil::error("Failed to open '", path, "': ", std::strerror(errno), '\n');
+    closeFd(entry->fd);
+    return false;
+  }
+
+  entry->file_size = uint64_t(file_stat.st_size);
+  std::ostringstream etag;
+  etag << "\"f" << std::hex << entry->file_size << '-' << uint64_t(file_stat.st_mtime) << '"';
+  entry->etag = etag.str();
+
+  const ohm::IndexedRegionIndex &index = entry->index;
+  entry->region_lookup.reserve(index.regions.size());
+  for (size_t i = 0; i < index.regions.size(); ++i)
+  {
+    entry->region_lookup.emplace(index.regions[i], uint32_t(i));
+  }
+
+  std::ostringstream info;
+  info << std::setprecision(std::numeric_limits<double>::max_digits10);
+  info << "{\"name\":";
+  jsonString(info, name);
+  info << ",\"version\":\"" << version.major << '.' << version.minor << '.' << version.patch << '"';
+  const glm::u8vec3 region_dim = map.regionVoxelDimensions();
+  info << ",\"resolution\":" << map.resolution() << ",\"region_dimensions\":[" << unsigned(region_dim.x) << ','
+       << unsigned(region_dim.y) << ',' << unsigned(region_dim.z) << ']';
+  info << ",\"origin\":[" << map.origin().x << ',' << map.origin().y << ',' << map.origin().z << ']';
+  info << ",\"flags\":" << unsigned(map.flags());
+  info << ",\"layers\":[";
+  for (size_t i = 0; i < index.layers.size(); ++i)
+  {
+    const ohm::MapLayer *layer = map.layout().layer(index.layers[i].c_str());
+    info << (i ? "," : "") << "{\"name\":";
+    jsonString(info, index.layers[i]);
+    info << ",\"voxel_byte_size\":" << (layer ? layer->voxelByteSize() : size_t(0)) << '}';
+  }
+  info << "],\"regions\":" << index.regions.size() << ",\"file_size\":" << entry->file_size
+       << ",\"header_size\":" << index.header_size << "}\n";
+  entry->info_json = info.str();
+
+  std::ostringstream index_json;
+  index_json << std::setprecision(std::numeric_limits<double>::max_digits10);
+  index_json << "{\"layers\":[";
+  for (size_t i = 0; i < index.layers.size(); ++i)
+  {
+    index_json << (i ? "," : "");
+    jsonString(index_json, index.layers[i]);
+  }
+  index_json << "],\"regions\":[";
+  for (size_t r = 0; r < index.regions.size(); ++r)
+  {
+    const glm::i16vec3 &coord = index.regions[r];
+    index_json << (r ? "," : "") << "{\"key\":[" << coord.x << ',' << coord.y << ',' << coord.z
+               << "],\"touched_time\":" << index.touched_times[r] << ",\"blobs\":[";
+    for (size_t i = 0; i < index.layers.size(); ++i)
+    {
+      const ohm::IndexedLayerBlob &blob = index.blob(r, i);
+      index_json << (i ? "," : "") << "{\"stamp\":" << blob.touched_stamp << ",\"offset\":" << blob.offset
+                 << ",\"size\":" << blob.stored_size << ",\"encoding\":\"" << encodingName(blob.encoding) << "\"}";
+    }
+    index_json << "]}";
+  }
+  index_json << "]}\n";
+  entry->index_json = index_json.str();
+
+  logutil::info("Serving '", path, "' as '", name, "': ", index.regions.size(), " regions\n");
+  imp_->map_lookup.emplace(name, uint32_t(imp_->maps.size()));
+  imp_->maps.emplace_back(std::move(entry));
+  return true;
+}
+
+
+size_t TileServer::mapCount() const
+{
+  return imp_->maps.size();
+}
+
+
+bool TileServer::listen()
+{
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(imp_->options.port);
+  if (::inet_pton(AF_INET, imp_->options.bind_address.c_str(), &address.sin_addr) != 1)
+  {
+    logutil::error("Invalid bind address '", imp_->options.bind_address, "'\n");
+    return false;
+  }
+
+  closeFd(imp_->listen_fd);
+  imp_->listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (imp_->listen_fd < 0)
+  {
+    logutil::error("Failed to create socket: ", std::strerror(errno), '\n');
+    return false;
+  }
+  ::fcntl(imp_->listen_fd, F_SETFD, FD_CLOEXEC);
+
+  int reuse = 1;
+  ::setsockopt(imp_->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  if (::bind(imp_->listen_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+      ::listen(imp_->listen_fd, kListenBacklog) != 0 || !setNonBlocking(imp_->listen_fd))
+  {
+    logutil::error("Failed to listen on ", imp_->options.bind_address, ':', imp_->options.port, ": ",
+                   std::strerror(errno), '\n');
+    closeFd(imp_->listen_fd);
+    return false;
+  }
+
+  socklen_t address_size = sizeof(address);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  ::getsockname(imp_->listen_fd, reinterpret_cast<sockaddr *>(&address), &address_size);
+  imp_->port = ntohs(address.sin_port);
+  return true;
+}
+
+
+uint16_t TileServer::port() const
+{
+  return (imp_->listen_fd >= 0) ? imp_->port : 0u;
+}
+
+
+void TileServer::run(const std::atomic_bool &quit)
+{
+  Detail &imp = *imp_;
+  if (imp.listen_fd < 0)
+  {
+    return;
+  }
+
+  const auto idle_timeout = std::chrono::milliseconds(imp.options.idle_timeout_ms);
+  std::vector<pollfd> poll_fds;
+  while (!quit)
+  {
+    // Stop accepting at the connection limit. Further clients wait in the listen backlog.
+    poll_fds.clear();
+    const bool accepting = imp.connections.size() < imp.options.max_clients;
+    poll_fds.emplace_back(pollfd{ imp.listen_fd, short(accepting ? POLLIN : 0), 0 });
+    for (const auto &connection : imp.connections)
+    {
+      poll_fds.emplace_back(pollfd{ connection->fd, short(connection->sending() ? POLLOUT : POLLIN), 0 });
+    }
+
+    const int ready = ::poll(poll_fds.data(), nfds_t(poll_fds.size()), kPollTimeoutMs);
+    if (ready < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      logutil::error("poll failed: ", std::strerror(errno), '\n');
+      break;
+    }
+
+    const Clock::time_point now = Clock::now();
+    for (size_t i = 0; i < imp.connections.size(); ++i)
+    {
+      Connection &connection = *imp.connections[i];
+      const short events = poll_fds[i + 1].revents;
+      bool keep = true;
+      if (events & (POLLERR | POLLNVAL))
+      {
+        keep = false;
+      }
+      else if (events & (POLLIN | POLLHUP))
+      {
+        keep = (connection.sending()) ? imp.pump(connection) : imp.receive(connection);
+        connection.last_active = now;
+      }
+      else if (events & POLLOUT)
+      {
+        keep = imp.pump(connection);
+        connection.last_active = now;
+      }
+      else
+      {
+        keep = now - connection.last_active < idle_timeout;
+      }
+
+      if (!keep)
+      {
+        closeFd(connection.fd);
+      }
+    }
+
+    imp.connections.erase(std::remove_if(imp.connections.begin(), imp.connections.end(),
+                                         [](const std::unique_ptr<Connection> &connection) {
+                                           return connection->fd < 0;
+                                         }),
+                          imp.connections.end());
+
+    if (poll_fds[0].revents & POLLIN)
+    {
+      imp.accept(now);
+    }
+  }
+}
+
+
+const BlobCache &TileServer::cache() const
+{
+  return imp_->cache;
+}
+}  // namespace ohmserve
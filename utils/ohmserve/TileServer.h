@@ -0,0 +1,107 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+#ifndef OHMSERVE_TILESERVER_H
+#define OHMSERVE_TILESERVER_H
+
+#include "BlobCache.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ohmserve
+{
+/// Configuration for a @c TileServer .
+struct TileServerOptions
+{
+  /// Address to listen on.
+  std::string bind_address = "127.0.0.1";
+  /// Port to listen on.
+  uint16_t port = 8080;  // NOLINT(readability-magic-numbers)
+  /// Byte capacity of the @c BlobCache .
+  size_t cache_bytes = size_t(256u) * 1024u * 1024u;  // NOLINT(readability-magic-numbers)
+  /// Number of requests for a region blob before it is cached. See @c BlobCache .
+  unsigned promote_hits = 2;
+  /// Maximum number of concurrent client connections. Further connections wait in the listen backlog.
+  unsigned max_clients = 1024;  // NOLINT(readability-magic-numbers)
+  /// Idle connections are closed after this many milliseconds.
+  unsigned idle_timeout_ms = 30000;  // NOLINT(readability-magic-numbers)
+};
+
+/// A lightweight HTTP/1.1 server sharing the regions of indexed map files - see @c ohm::saveIndexed() - by key.
+///
+/// Each map is registered under a name with @c addMap() . Only the map header and region index table are loaded: region
+/// layer blobs are served as stored in the file, normally zlib compressed, for clients to decode. Heightmap tiles are
+/// served the same way from a heightmap saved as an indexed map. The following GET and HEAD resources are supported:
+/// - `/maps` : JSON list of the map names.
+/// - `/stats` : JSON server and cache statistics.
+/// - `/<map>/info` : JSON map details: resolution, region dimensions, origin, stored layers and region count.
+/// - `/<map>/index` : JSON region index: each region's key, touched time and the stamp, size and encoding of each
+///   stored layer blob.
+/// - `/<map>/header` : the file bytes preceding the region blobs; the map header, @c MapInfo and @c MapLayout .
+/// - `/<map>/file` : the whole map file.
+/// - `/<map>/region/<x>/<y>/<z>/<layer>` : the blob for one layer of one region. The `X-Ohm-Encoding` response header
+///   gives the blob encoding: `raw` , `zlib` or `sparse` .
+///
+/// Region blob responses carry an `ETag` derived from the layer touched stamp and blob location, so clients may
+/// revalidate with `If-None-Match` and receive `304 Not Modified` for unchanged regions. Other file resources use the
+/// file size and modification time. File resources support single `Range` requests - with `If-Range` - so clients may
+/// also read the indexed file directly using the offsets from `/<map>/index` .
+///
+/// The server runs a single threaded event loop over non-blocking sockets using `poll()` , so many clients are served
+/// concurrently without a thread per connection. Hot blobs are held in a @c BlobCache and sent from memory. Other file
+/// content is sent without copying through user space using `sendfile()` on Linux, or with positional reads elsewhere.
+/// Requests may be pipelined over keep alive connections.
+///
+/// Map files must not be modified while served. This requires a POSIX platform.
+class TileServer
+{
+public:
+  /// Constructor.
+  /// @param options Server configuration.
+  explicit TileServer(const TileServerOptions &options);
+  /// Destructor: closes all connections and map files.
+  ~TileServer();
+
+  TileServer(const TileServer &) = delete;
+  TileServer &operator=(const TileServer &) = delete;
+
+  /// Register the indexed map file at @p path under @p name . Must be called before @c run() .
+  /// @param name The map name used in resource paths. Must be non empty and contain no '/'.
+  /// @param path The indexed map file path.
+  /// @return True on success. Errors are logged.
+  bool addMap(const std::string &name, const std::string &path);
+
+  /// Query the number of registered maps.
+  /// @return The map count.
+  size_t mapCount() const;
+
+  /// Bind and listen on the configured address and port.
+  /// @return True on success. Errors are logged.
+  bool listen();
+
+  /// Query the port the server is listening on. This resolves the port when listening on port zero.
+  /// @return The listening port or zero when not listening.
+  uint16_t port() const;
+
+  /// Serve requests until @p quit becomes true.
+  /// @param quit Flag polled at least every few hundred milliseconds to stop the server.
+  void run(const std::atomic_bool &quit);
+
+  /// Access the blob cache.
+  /// @return The blob cache.
+  const BlobCache &cache() const;
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> imp_;
+};
+}  // namespace ohmserve
+
+#endif  // OHMSERVE_TILESERVER_H
@@ -0,0 +1,145 @@
+//
+// author Kazys Stepanas
+//
+#include "TileServer.h"
+
+#include <ohmutil/Options.h>
+
+#include <logutil/LogUtil.h>
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+std::atomic_bool g_quit(false);
+
+void onSignal(int arg)
+{
+  if (arg == SIGINT || arg == SIGTERM)
+  {
+    g_quit = true;
+  }
+}
+
+struct Options
+{
+  std::vector<std::string> maps;
+  ohmserve::TileServerOptions server;
+  unsigned cache_mib = 256;  // NOLINT(readability-magic-numbers)
+};
+
+/// Resolve a `name=path` map argument, or derive the name from the file stem of a plain path.
+void mapArgument(const std::string &arg, std::string *name, std::string *path)
+{
+  const size_t equals = arg.find('=');
+  if (equals != std::string::npos)
+  {
+    *name = arg.substr(0, equals);
+    *path = arg.substr(equals + 1);
+    return;
+  }
+
+  *path = arg;
+  const size_t slash = arg.find_last_of("/\\");
+  *name = (slash != std::string::npos) ? arg.substr(slash + 1) : arg;
+  const size_t dot = name->find_last_of('.');
+  if (dot != std::string::npos && dot > 0)
+  {
+    name->erase(dot);
+  }
+}
+}  // namespace
+
+
+int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoid-c-arrays)
+{
+  cxxopts::Options opt_parse(argv[0], "\nServe the regions of indexed occupancy map files over HTTP. Maps must be in "
+                                      "the indexed format; see ohmupgrade.\n");
+  opt_parse.positional_help("<map.ohm> [<map.ohm> ...]");
+
+  try
+  {
+    // clang-format off
+    opt_parse.add_options()
+      ("help", "Show help.")
+      ("map", "A map file to serve as <name>=<path>, or <path> to name the map by its file stem. May be repeated.", cxxopts::value(opt->maps))
+      ("bind", "The address to listen on.", optVal(opt->server.bind_address))
+      ("port", "The port to listen on.", optVal(opt->server.port))
+      ("cache", "Region blob cache size (MiB). Zero to disable.", optVal(opt->cache_mib))
+      ("promote", "Number of requests for a region blob before it is cached.", optVal(opt->server.promote_hits))
+      ("max-clients", "Maximum number of concurrent connections.", optVal(opt->server.max_clients))
+      ("idle-timeout", "Close idle connections after this many milliseconds.", optVal(opt->server.idle_timeout_ms))
+      ;
+    // clang-format on
+
+    opt_parse.parse_positional({ "map" });
+
+    cxxopts::ParseResult parsed = opt_parse.parse(argc, argv);
+
+    if (parsed.count("help") || parsed.arguments().empty())
+    {
+      // show usage.
+      std::cout << opt_parse.help({ "", "Group" }) << std::endl;
+      return 1;
+    }
+
+    if (opt->maps.empty())
+    {
+      std::cerr << "Missing input map" << std::endl;
+      return -1;
+    }
+  }
+  catch (const cxxopts::OptionException &e)
+  {
+    std::cerr << "Argument error\n" << e.what() << std::endl;
+    return -1;
+  }
+
+  opt->server.cache_bytes = size_t(opt->cache_mib) * 1024u * 1024u;
+  return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  Options opt;
+
+  int res = parseOptions(&opt, argc, argv);
+
+  if (res)
+  {
+    return res;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  // Clients may disconnect mid response.
+  signal(SIGPIPE, SIG_IGN);
+
+  ohmserve::TileServer server(opt.server);
+  for (const std::string &arg : opt.maps)
+  {
+    std::string name;
+    std::string path;
+    mapArgument(arg, &name, &path);
+    if (!server.addMap(name, path))
+    {
+      return 1;
+    }
+  }
+
+  if (!server.listen())
+  {
+    return 1;
+  }
+
+  logutil::info("Listening on ", opt.server.bind_address, ':', server.port(), '\n');
+  server.run(g_quit);
+  logutil::info("Shutting down\n");
+
+  return 0;
+}
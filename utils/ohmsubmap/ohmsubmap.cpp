@@ -141,7 +141,8 @@ int main(int argc, char *argv[])
   ohm::OccupancyMap map(1.0f);
 
   std::cout << "Loading" << std::flush;
-  res = ohm::load(opt.map_in.c_str(), map);
+  // Only load the regions overlapping the box. This avoids decompressing other regions of indexed map files.
+  res = ohm::load(opt.map_in.c_str(), map, opt.box);
   std::cout << std::endl;
 
   if (res != 0)
@@ -0,0 +1,190 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Kazys Stepanas
+
+// ohmupgrade converts ohm maps saved by older library versions to the current or indexed map format.
+
+#include <ohm/MapSerialise.h>
+#include <ohm/MapUpgrade.h>
+
+#include <ohmutil/Options.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Options
+{
+  std::vector<std::string> inputs;
+  std::string list_file;
+  std::string output_dir;
+  std::string format = "indexed";
+  bool raw = false;
+  bool sparse = false;
+  bool verify = true;
+  bool force = false;
+  bool quiet = false;
+};
+
+
+int parseOptions(Options *opt, int argc, char *argv[])  // NOLINT(modernize-avoid-c-arrays)
+{
+  cxxopts::Options opt_parse(argv[0], "\nUpgrade ohm map files to the current or indexed map format, converting "
+                                      "files in parallel and verifying each result.\n");
+  opt_parse.positional_help("<map.ohm> [<map.ohm> ...]");
+
+  try
+  {
+    // clang-format off
+    opt_parse.add_options()
+      ("help", "Show help.")
+      ("i,input", "The map files to upgrade.", cxxopts::value(opt->inputs))
+      ("force", "Rewrite maps already at the target format version.", optVal(opt->force))
+      ("format", "The target format: [current, indexed].", optVal(opt->format))
+      ("list", "A text file listing map files to upgrade, one per line. Added to the input files.", optVal(opt->list_file))
+      ("output-dir", "Directory to write upgraded maps to, keeping the input file names. Maps are upgraded in place when empty.", optVal(opt->output_dir))
+      ("q,quiet", "Only report failures.", optVal(opt->quiet))
+      ("raw", "Store indexed map regions uncompressed for faster paging.", optVal(opt->raw))
+      ("sparse", "Store sparse indexed map region layers as masked values.", optVal(opt->sparse))
+      ("verify", "Reload each upgraded map and verify the region content hashes before replacing the output file.", optVal(opt->verify))
+      ;
+    // clang-format on
+
+    opt_parse.parse_positional({ "input" });
+
+    cxxopts::ParseResult parsed = opt_parse.parse(argc, argv);
+
+    if (parsed.count("help") || parsed.arguments().empty())
+    {
+      // show usage.
+      std::cout << opt_parse.help({ "" }) << std::endl;
+      return 1;
+    }
+
+    if (opt->format != "current" && opt->format != "indexed")
+    {
+      std::cerr << "Unknown format " << opt->format << std::endl;
+      return -1;
+    }
+
+    if (!opt->list_file.empty())
+    {
+      std::ifstream list(opt->list_file.c_str());
+      if (!list.is_open())
+      {
+        std::cerr << "Unable to read " << opt->list_file << std::endl;
+        return -1;
+      }
+      std::string line;
+      while (std::getline(list, line))
+      {
+        if (!line.empty())
+        {
+          opt->inputs.emplace_back(line);
+        }
+      }
+    }
+
+    if (opt->inputs.empty())
+    {
+      std::cerr << "Missing input maps" << std::endl;
+      return -1;
+    }
+  }
+  catch (const cxxopts::OptionException &e)
+  {
+    std::cerr << "Argument error\n" << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+std::string outputPath(const std::string &input, const std::string &output_dir)
+{
+  if (output_dir.empty())
+  {
+    return input;
+  }
+
+  const size_t separator = input.find_last_of("/\\");
+  const std::string file_name = (separator != std::string::npos) ? input.substr(separator + 1) : input;
+  const char last = output_dir.back();
+  return (last == '/' || last == '\\') ? output_dir + file_name : output_dir + "/" + file_name;
+}
+}  // namespace
+
+
+int main(int argc, char *argv[])
+{
+  Options opt;
+
+  std::cout.imbue(std::locale(""));
+
+  int res = parseOptions(&opt, argc, argv);
+  if (res)
+  {
+    return res;
+  }
+
+  ohm::MapUpgradeOptions upgrade_options;
+  upgrade_options.format =
+    (opt.format == "current") ? ohm::MapUpgradeFormat::kCurrent : ohm::MapUpgradeFormat::kIndexed;
+  upgrade_options.indexed_flags = ohm::kImfParallel;
+  upgrade_options.indexed_flags |= (!opt.raw) ? ohm::kImfCompress : 0u;
+  upgrade_options.indexed_flags |= (opt.sparse) ? ohm::kImfSparse : 0u;
+  upgrade_options.verify = opt.verify;
+  upgrade_options.skip_current = !opt.force;
+
+  std::vector<std::pair<std::string, std::string>> files;
+  files.reserve(opt.inputs.size());
+  for (const std::string &input : opt.inputs)
+  {
+    files.emplace_back(input, outputPath(input, opt.output_dir));
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+  std::vector<ohm::MapUpgradeResult> results;
+  const size_t success_count =
+    ohm::upgradeMaps(files, upgrade_options, results, [&opt](const ohm::MapUpgradeResult &result) {
+      if (result.error)
+      {
+        std::cerr << result.source << ": failed: " << ohm::serialiseErrorCodeString(result.error);
+        if (result.mismatched_regions)
+        {
+          std::cerr << " (" << result.mismatched_regions << " mismatched regions)";
+        }
+        std::cerr << std::endl;
+      }
+      else if (!opt.quiet)
+      {
+        std::cout << result.source << ": v" << result.source_version.major << '.' << result.source_version.minor
+                  << '.' << result.source_version.patch;
+        if (result.skipped)
+        {
+          std::cout << " skipped: already current" << std::endl;
+        }
+        else
+        {
+          std::cout << " -> " << result.destination << " : " << result.region_count << " regions"
+                    << ((result.verified) ? " verified " : " ") << result.seconds << "s" << std::endl;
+        }
+      }
+    });
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  if (!opt.quiet)
+  {
+    std::cout << success_count << " / " << files.size() << " maps upgraded in " << elapsed << "s" << std::endl;
+  }
+
+  return (success_count == files.size()) ? 0 : 1;
+}